@@ -0,0 +1,2577 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * bench measures the speed of the internal data structures of
+ * ngtcp2 under the workloads which resemble what a busy connection
+ * does to them.  The result is written to stdout in JSON so that it
+ * can be compared between revisions.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include "ngtcp2_ksl.h"
+#include "ngtcp2_map.h"
+#include "ngtcp2_pq.h"
+#include "ngtcp2_cycleq.h"
+#include "ngtcp2_rob.h"
+#include "ngtcp2_gaptr.h"
+#include "ngtcp2_acktr.h"
+#include "ngtcp2_rtb.h"
+#include "ngtcp2_rst.h"
+#include "ngtcp2_strm.h"
+#include "ngtcp2_cid.h"
+#include "ngtcp2_cc.h"
+#include "ngtcp2_bbr.h"
+#include "ngtcp2_bbr2.h"
+#include "ngtcp2_pkt.h"
+#include "ngtcp2_conv.h"
+#include "ngtcp2_log.h"
+#include "ngtcp2_mem.h"
+#include "ngtcp2_macro.h"
+#include "ngtcp2_conn.h"
+
+#define BENCH_PKTLEN 1200
+
+/* bench_func runs a benchmark over |n| elements and returns the
+   number of nanoseconds spent in the measured part.  The number of
+   operations performed is assigned to |*pops|. */
+typedef uint64_t (*bench_func)(size_t n, uint64_t *pops);
+
+typedef struct bench {
+  const char *name;
+  size_t n;
+  bench_func func;
+} bench;
+
+static uint64_t bench_rand_state;
+
+/* bench_bytes is the number of bytes of memory held per operation
+   which the benchmark reports.  It is 0 if the benchmark does not
+   measure the memory usage. */
+static uint64_t bench_bytes;
+
+/* bench_conn_stat holds the figures per connection which the
+   connection benchmarks report in addition to bench_bytes.  A figure
+   is not reported if it is 0.  The figures of the fastest round are
+   reported. */
+static struct bench_conn_stat {
+  /* allocs is the number of allocations made to set up a
+     connection. */
+  uint64_t allocs;
+  /* rss_bytes is the growth of the resident set size. */
+  uint64_t rss_bytes;
+  /* new_ns is the time spent in ngtcp2_conn_server_new. */
+  uint64_t new_ns;
+  /* del_ns is the time spent in ngtcp2_conn_del. */
+  uint64_t del_ns;
+  /* total_allocs is the number of allocations made by the measured
+     part in total.  It is used where the allocations per operation
+     are expected to be well below 1. */
+  uint64_t total_allocs;
+} bench_conn_stat, best_conn_stat;
+
+static uint64_t bench_rand(void) {
+  /* splitmix64 */
+  uint64_t z = (bench_rand_state += 0x9e3779b97f4a7c15llu);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9llu;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebllu;
+  return z ^ (z >> 31);
+}
+
+static uint64_t timestamp_ns(void) {
+  struct timespec tp;
+
+  clock_gettime(CLOCK_MONOTONIC, &tp);
+
+  return (uint64_t)tp.tv_sec * 1000000000 + (uint64_t)tp.tv_nsec;
+}
+
+static void *xmalloc(size_t size) {
+  void *p = malloc(size);
+
+  if (p == NULL) {
+    fprintf(stderr, "bench: out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return p;
+}
+
+static void check(int rv, const char *what) {
+  if (rv != 0) {
+    fprintf(stderr, "bench: %s failed: %d\n", what, rv);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/*
+ * rss_bytes returns the resident set size of this process, or 0 if
+ * it is unknown.
+ */
+static uint64_t rss_bytes(void) {
+  FILE *f = fopen("/proc/self/statm", "r");
+  unsigned long size, resident;
+  int rv;
+
+  if (f == NULL) {
+    return 0;
+  }
+
+  rv = fscanf(f, "%lu %lu", &size, &resident);
+
+  fclose(f);
+
+  if (rv != 2) {
+    return 0;
+  }
+
+  return (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+/*
+ * rss_growth returns the growth of the resident set size since it
+ * was |rss|.
+ */
+static uint64_t rss_growth(uint64_t rss) {
+  uint64_t now = rss_bytes();
+
+  return now > rss ? now - rss : 0;
+}
+
+/* bench_nalloc is the number of allocations made through
+   bench_counting_mem. */
+static uint64_t bench_nalloc;
+
+static void *counting_malloc(size_t size, void *user_data) {
+  (void)user_data;
+
+  ++bench_nalloc;
+
+  return malloc(size);
+}
+
+static void counting_free(void *ptr, void *user_data) {
+  (void)user_data;
+
+  free(ptr);
+}
+
+static void *counting_calloc(size_t nmemb, size_t size, void *user_data) {
+  (void)user_data;
+
+  ++bench_nalloc;
+
+  return calloc(nmemb, size);
+}
+
+static void *counting_realloc(void *ptr, size_t size, void *user_data) {
+  (void)user_data;
+
+  ++bench_nalloc;
+
+  return realloc(ptr, size);
+}
+
+/* bench_counting_mem is ngtcp2_mem which counts allocations in
+   bench_nalloc. */
+static const ngtcp2_mem bench_counting_mem = {
+    NULL, counting_malloc, counting_free, counting_calloc, counting_realloc,
+};
+
+/*
+ * shuffled_keys returns |n| distinct keys in random order.
+ */
+static int64_t *shuffled_keys(size_t n) {
+  int64_t *keys = xmalloc(sizeof(int64_t) * n);
+  size_t i, j;
+  int64_t t;
+
+  for (i = 0; i < n; ++i) {
+    keys[i] = (int64_t)i * 7;
+  }
+
+  for (i = n; i > 1; --i) {
+    j = (size_t)(bench_rand() % i);
+    t = keys[i - 1];
+    keys[i - 1] = keys[j];
+    keys[j] = t;
+  }
+
+  return keys;
+}
+
+/*
+ * reordered_indices returns the permutation of [0, n) which models
+ * heavy reordering: indices are delivered in reverse order inside
+ * windows of random size up to 64, and some of them are delayed by
+ * up to 256 positions.
+ */
+static size_t *reordered_indices(size_t n) {
+  size_t *idx = xmalloc(sizeof(size_t) * n);
+  size_t i, j, w, t;
+
+  for (i = 0; i < n; i += w) {
+    w = (size_t)(bench_rand() % 64) + 1;
+    w = ngtcp2_min(w, n - i);
+    for (j = 0; j < w; ++j) {
+      idx[i + j] = i + w - 1 - j;
+    }
+  }
+
+  for (i = 0; i + 1 < n; ++i) {
+    if (bench_rand() % 8) {
+      continue;
+    }
+
+    j = i + (size_t)(bench_rand() % 256) + 1;
+    j = ngtcp2_min(j, n - 1);
+    t = idx[i];
+    idx[i] = idx[j];
+    idx[j] = t;
+  }
+
+  return idx;
+}
+
+static void ksl_fill(ngtcp2_ksl *ksl, const int64_t *keys, size_t n) {
+  size_t i;
+
+  ngtcp2_ksl_init(ksl, ngtcp2_ksl_int64_less, sizeof(int64_t),
+                  ngtcp2_mem_default());
+
+  for (i = 0; i < n; ++i) {
+    check(ngtcp2_ksl_insert(ksl, NULL, &keys[i], NULL), "ngtcp2_ksl_insert");
+  }
+}
+
+static uint64_t bench_ksl_insert(size_t n, uint64_t *pops) {
+  int64_t *keys = shuffled_keys(n);
+  ngtcp2_ksl ksl;
+  uint64_t t;
+
+  t = timestamp_ns();
+  ksl_fill(&ksl, keys, n);
+  t = timestamp_ns() - t;
+
+  ngtcp2_ksl_free(&ksl);
+  free(keys);
+
+  *pops = n;
+
+  return t;
+}
+
+static uint64_t bench_ksl_lookup(size_t n, uint64_t *pops) {
+  int64_t *keys = shuffled_keys(n);
+  ngtcp2_ksl ksl;
+  ngtcp2_ksl_it it;
+  uint64_t t;
+  size_t i;
+
+  ksl_fill(&ksl, keys, n);
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    it = ngtcp2_ksl_lower_bound(&ksl, &keys[i]);
+    assert(!ngtcp2_ksl_it_end(&it));
+    (void)it;
+  }
+  t = timestamp_ns() - t;
+
+  ngtcp2_ksl_free(&ksl);
+  free(keys);
+
+  *pops = n;
+
+  return t;
+}
+
+static uint64_t bench_ksl_iterate(size_t n, uint64_t *pops) {
+  int64_t *keys = shuffled_keys(n);
+  ngtcp2_ksl ksl;
+  ngtcp2_ksl_it it;
+  uint64_t t;
+  int64_t sum = 0;
+  size_t cnt = 0;
+
+  ksl_fill(&ksl, keys, n);
+
+  t = timestamp_ns();
+  for (it = ngtcp2_ksl_begin(&ksl); !ngtcp2_ksl_it_end(&it);
+       ngtcp2_ksl_it_next(&it)) {
+    sum += *(int64_t *)ngtcp2_ksl_it_key(&it);
+    ++cnt;
+  }
+  t = timestamp_ns() - t;
+
+  assert(cnt == n);
+  (void)sum;
+
+  ngtcp2_ksl_free(&ksl);
+  free(keys);
+
+  *pops = n;
+
+  return t;
+}
+
+static uint64_t bench_ksl_remove(size_t n, uint64_t *pops) {
+  int64_t *keys = shuffled_keys(n);
+  ngtcp2_ksl ksl;
+  uint64_t t;
+  size_t i;
+
+  ksl_fill(&ksl, keys, n);
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    check(ngtcp2_ksl_remove(&ksl, NULL, &keys[n - 1 - i]),
+          "ngtcp2_ksl_remove");
+  }
+  t = timestamp_ns() - t;
+
+  ngtcp2_ksl_free(&ksl);
+  free(keys);
+
+  *pops = n;
+
+  return t;
+}
+
+static void map_fill(ngtcp2_map *map, const int64_t *keys, size_t n) {
+  size_t i;
+
+  ngtcp2_map_init(map, ngtcp2_mem_default());
+
+  for (i = 0; i < n; ++i) {
+    check(ngtcp2_map_insert(map, (ngtcp2_map_key_type)keys[i],
+                            (void *)&keys[i]),
+          "ngtcp2_map_insert");
+  }
+}
+
+static uint64_t bench_map_insert(size_t n, uint64_t *pops) {
+  int64_t *keys = shuffled_keys(n);
+  ngtcp2_map map;
+  uint64_t t;
+
+  t = timestamp_ns();
+  map_fill(&map, keys, n);
+  t = timestamp_ns() - t;
+
+  ngtcp2_map_free(&map);
+  free(keys);
+
+  *pops = n;
+
+  return t;
+}
+
+static uint64_t bench_map_lookup(size_t n, uint64_t *pops) {
+  int64_t *keys = shuffled_keys(n);
+  ngtcp2_map map;
+  uint64_t t;
+  size_t i;
+  void *p;
+
+  map_fill(&map, keys, n);
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    p = ngtcp2_map_find(&map, (ngtcp2_map_key_type)keys[n - 1 - i]);
+    assert(p);
+    (void)p;
+  }
+  t = timestamp_ns() - t;
+
+  ngtcp2_map_free(&map);
+  free(keys);
+
+  *pops = n;
+
+  return t;
+}
+
+static uint64_t bench_map_remove(size_t n, uint64_t *pops) {
+  int64_t *keys = shuffled_keys(n);
+  ngtcp2_map map;
+  uint64_t t;
+  size_t i;
+
+  map_fill(&map, keys, n);
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    check(ngtcp2_map_remove(&map, (ngtcp2_map_key_type)keys[i]),
+          "ngtcp2_map_remove");
+  }
+  t = timestamp_ns() - t;
+
+  ngtcp2_map_free(&map);
+  free(keys);
+
+  *pops = n;
+
+  return t;
+}
+
+typedef struct pq_item {
+  ngtcp2_pq_entry pe;
+  uint64_t key;
+} pq_item;
+
+static int pq_item_less(const ngtcp2_pq_entry *lhs,
+                        const ngtcp2_pq_entry *rhs) {
+  return ngtcp2_struct_of(lhs, pq_item, pe)->key <
+         ngtcp2_struct_of(rhs, pq_item, pe)->key;
+}
+
+/*
+ * pq_push_pop models the stream scheduler: the front item is popped
+ * and pushed again with a larger key.  |arity| is the number of
+ * children of each heap node.
+ */
+static uint64_t pq_push_pop(size_t n, size_t arity, uint64_t *pops) {
+  pq_item *items = xmalloc(sizeof(pq_item) * n);
+  ngtcp2_pq pq;
+  pq_item *item;
+  uint64_t t;
+  size_t i;
+
+  ngtcp2_pq_init_arity(&pq, pq_item_less, arity, ngtcp2_mem_default());
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    items[i].key = bench_rand() % n;
+    check(ngtcp2_pq_push(&pq, &items[i].pe), "ngtcp2_pq_push");
+  }
+
+  for (i = 0; i < n * 4; ++i) {
+    item = ngtcp2_struct_of(ngtcp2_pq_top(&pq), pq_item, pe);
+    ngtcp2_pq_pop(&pq);
+    item->key += bench_rand() % n + 1;
+    check(ngtcp2_pq_push(&pq, &item->pe), "ngtcp2_pq_push");
+  }
+
+  for (; !ngtcp2_pq_empty(&pq);) {
+    ngtcp2_pq_pop(&pq);
+  }
+  t = timestamp_ns() - t;
+
+  ngtcp2_pq_free(&pq);
+  free(items);
+
+  *pops = n * 6;
+
+  return t;
+}
+
+static uint64_t bench_pq_push_pop(size_t n, uint64_t *pops) {
+  return pq_push_pop(n, 2, pops);
+}
+
+static uint64_t bench_pq4_push_pop(size_t n, uint64_t *pops) {
+  return pq_push_pop(n, 4, pops);
+}
+
+typedef struct rr_item {
+  ngtcp2_pq_entry pe;
+  uint64_t cycle;
+  int64_t id;
+} rr_item;
+
+static int rr_item_less(const ngtcp2_pq_entry *lhs,
+                        const ngtcp2_pq_entry *rhs) {
+  rr_item *l = ngtcp2_struct_of(lhs, rr_item, pe);
+  rr_item *r = ngtcp2_struct_of(rhs, rr_item, pe);
+
+  if (l->cycle == r->cycle) {
+    return l->id < r->id;
+  }
+
+  return l->cycle < r->cycle;
+}
+
+static int rr_item_id_less(const ngtcp2_pq_entry *lhs,
+                           const ngtcp2_pq_entry *rhs) {
+  return ngtcp2_struct_of(lhs, rr_item, pe)->id <
+         ngtcp2_struct_of(rhs, rr_item, pe)->id;
+}
+
+static uint64_t rr_item_cycle(const ngtcp2_pq_entry *pe) {
+  return ngtcp2_struct_of(pe, rr_item, pe)->cycle;
+}
+
+static rr_item *rr_items(size_t n) {
+  rr_item *items = xmalloc(sizeof(rr_item) * n);
+  int64_t *keys = shuffled_keys(n);
+  size_t i;
+
+  for (i = 0; i < n; ++i) {
+    items[i].cycle = 0;
+    items[i].id = keys[i];
+  }
+
+  free(keys);
+
+  return items;
+}
+
+/*
+ * pq_round_robin models the round-robin stream scheduler with |n|
+ * active streams: the front stream sends data and it is pushed
+ * again at the next cycle.  The streams are pushed in random order.
+ */
+static uint64_t pq_round_robin(size_t n, size_t arity, uint64_t *pops) {
+  rr_item *items = rr_items(n);
+  ngtcp2_pq pq;
+  rr_item *item;
+  uint64_t t;
+  size_t i;
+
+  ngtcp2_pq_init_arity(&pq, rr_item_less, arity, ngtcp2_mem_default());
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    check(ngtcp2_pq_push(&pq, &items[i].pe), "ngtcp2_pq_push");
+  }
+
+  for (i = 0; i < n * 4; ++i) {
+    item = ngtcp2_struct_of(ngtcp2_pq_top(&pq), rr_item, pe);
+    ngtcp2_pq_pop(&pq);
+    ++item->cycle;
+    check(ngtcp2_pq_push(&pq, &item->pe), "ngtcp2_pq_push");
+  }
+
+  for (; !ngtcp2_pq_empty(&pq);) {
+    ngtcp2_pq_pop(&pq);
+  }
+  t = timestamp_ns() - t;
+
+  ngtcp2_pq_free(&pq);
+  free(items);
+
+  *pops = n * 6;
+
+  return t;
+}
+
+static uint64_t bench_pq_round_robin(size_t n, uint64_t *pops) {
+  return pq_round_robin(n, 2, pops);
+}
+
+static uint64_t bench_pq4_round_robin(size_t n, uint64_t *pops) {
+  return pq_round_robin(n, 4, pops);
+}
+
+/*
+ * bench_cycleq_round_robin is bench_pq_round_robin with
+ * ngtcp2_cycleq which the connection uses for the non-strict
+ * scheduling policies.
+ */
+static uint64_t bench_cycleq_round_robin(size_t n, uint64_t *pops) {
+  rr_item *items = rr_items(n);
+  ngtcp2_cycleq cq;
+  rr_item *item;
+  uint64_t t;
+  size_t i;
+
+  ngtcp2_cycleq_init(&cq, rr_item_cycle, rr_item_id_less,
+                     ngtcp2_mem_default());
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    check(ngtcp2_cycleq_push(&cq, &items[i].pe), "ngtcp2_cycleq_push");
+  }
+
+  for (i = 0; i < n * 4; ++i) {
+    item = ngtcp2_struct_of(ngtcp2_cycleq_top(&cq), rr_item, pe);
+    ngtcp2_cycleq_pop(&cq);
+    ++item->cycle;
+    check(ngtcp2_cycleq_push(&cq, &item->pe), "ngtcp2_cycleq_push");
+  }
+
+  for (; !ngtcp2_cycleq_empty(&cq);) {
+    ngtcp2_cycleq_pop(&cq);
+  }
+  t = timestamp_ns() - t;
+
+  ngtcp2_cycleq_free(&cq);
+  free(items);
+
+  *pops = n * 6;
+
+  return t;
+}
+
+/*
+ * bench_rob_reorder pushes |n| STREAM frames of BENCH_PKTLEN bytes
+ * each in heavily reordered order, and drains the contiguous data
+ * as an application would do.
+ */
+static uint64_t bench_rob_reorder(size_t n, uint64_t *pops) {
+  size_t *idx = reordered_indices(n);
+  static const uint8_t data[BENCH_PKTLEN];
+  ngtcp2_rob rob;
+  const uint8_t *p;
+  uint64_t offset = 0;
+  uint64_t t;
+  size_t i, len;
+
+  check(ngtcp2_rob_init(&rob, 8 * 1024, ngtcp2_mem_default()),
+        "ngtcp2_rob_init");
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    check(ngtcp2_rob_push(&rob, (uint64_t)idx[i] * BENCH_PKTLEN, data,
+                          BENCH_PKTLEN),
+          "ngtcp2_rob_push");
+
+    for (; (len = ngtcp2_rob_data_at(&rob, &p, offset)) > 0;) {
+      ngtcp2_rob_pop(&rob, offset, len);
+      offset += len;
+    }
+
+    check(ngtcp2_rob_remove_prefix(&rob, offset), "ngtcp2_rob_remove_prefix");
+  }
+  t = timestamp_ns() - t;
+
+  assert(offset == (uint64_t)n * BENCH_PKTLEN);
+
+  ngtcp2_rob_free(&rob);
+  free(idx);
+
+  *pops = n;
+
+  return t;
+}
+
+/*
+ * bench_gaptr_reorder records the same reordered ranges as
+ * bench_rob_reorder in ngtcp2_gaptr, which tracks the received
+ * offsets of STREAM and CRYPTO data.
+ */
+static uint64_t bench_gaptr_reorder(size_t n, uint64_t *pops) {
+  size_t *idx = reordered_indices(n);
+  ngtcp2_gaptr gaptr;
+  uint64_t t;
+  size_t i;
+
+  ngtcp2_gaptr_init(&gaptr, ngtcp2_mem_default());
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    check(ngtcp2_gaptr_push(&gaptr, (uint64_t)idx[i] * BENCH_PKTLEN,
+                            BENCH_PKTLEN),
+          "ngtcp2_gaptr_push");
+    (void)ngtcp2_gaptr_first_gap_offset(&gaptr);
+  }
+  t = timestamp_ns() - t;
+
+  assert(ngtcp2_gaptr_first_gap_offset(&gaptr) == (uint64_t)n * BENCH_PKTLEN);
+
+  ngtcp2_gaptr_free(&gaptr);
+  free(idx);
+
+  *pops = n;
+
+  return t;
+}
+
+/*
+ * bench_acktr_ack_loss receives |n| packets with 1% of them missing.
+ * An ACK frame is generated every 2 packets, and half of the packets
+ * which carry ACK frames are lost, so acknowledged ranges are
+ * forgotten only when the surviving ACKs are acknowledged.
+ */
+static uint64_t bench_acktr_ack_loss(size_t n, uint64_t *pops) {
+  ngtcp2_acktr acktr;
+  ngtcp2_log log;
+  ngtcp2_acktr_entry *ent;
+  union {
+    ngtcp2_ack ack;
+    uint8_t buf[sizeof(ngtcp2_ack) +
+                sizeof(ngtcp2_ack_blk) * (NGTCP2_MAX_ACK_BLKS - 1)];
+  } fr;
+  int64_t pkt_num, tx_pkt_num = 0, min_pkt_num;
+  uint64_t t;
+  size_t i, j, nblks;
+
+  ngtcp2_log_init(&log, NULL, NULL, NULL, 0, NULL);
+  check(ngtcp2_acktr_init(&acktr, &log, ngtcp2_mem_default()),
+        "ngtcp2_acktr_init");
+
+  memset(&fr, 0, sizeof(fr));
+
+  t = timestamp_ns();
+  for (i = 0, pkt_num = 0; i < n; ++i, ++pkt_num) {
+    if (bench_rand() % 100 == 0) {
+      ++pkt_num;
+    }
+
+    check(ngtcp2_acktr_add(&acktr, pkt_num, /* active_ack = */ 1,
+                           (ngtcp2_tstamp)i),
+          "ngtcp2_acktr_add");
+
+    if (i % 2 == 0) {
+      continue;
+    }
+
+    /* Build ACK frame like conn_create_ack_frame does. */
+    ent = ngtcp2_acktr_get(&acktr, 0);
+    min_pkt_num = ent->pkt_num - (int64_t)ent->len + 1;
+    nblks = 0;
+
+    for (j = 1;
+         j < ngtcp2_acktr_len(&acktr) && nblks < NGTCP2_MAX_ACK_BLKS - 1;
+         ++j, ++nblks) {
+      ent = ngtcp2_acktr_get(&acktr, j);
+      fr.ack.blks[nblks].gap = (uint64_t)(min_pkt_num - ent->pkt_num - 2);
+      fr.ack.blks[nblks].blklen = ent->len - 1;
+      min_pkt_num = ent->pkt_num - (int64_t)ent->len + 1;
+    }
+
+    ngtcp2_acktr_commit_ack(&acktr);
+    ngtcp2_acktr_add_ack(&acktr, tx_pkt_num, pkt_num);
+
+    /* The peer acknowledges the packet which carries ACK frame one
+       round later unless it is lost. */
+    if (tx_pkt_num > 0 && bench_rand() % 2) {
+      fr.ack.largest_ack = tx_pkt_num - 1;
+      fr.ack.first_ack_blklen = 0;
+      fr.ack.num_blks = 0;
+      ngtcp2_acktr_recv_ack(&acktr, &fr.ack);
+    }
+
+    ++tx_pkt_num;
+  }
+  t = timestamp_ns() - t;
+
+  ngtcp2_acktr_free(&acktr);
+
+  *pops = n;
+
+  return t;
+}
+
+typedef struct rtb_ctx {
+  ngtcp2_rtb rtb;
+  ngtcp2_strm crypto;
+  ngtcp2_rst rst;
+  ngtcp2_cc cc;
+  ngtcp2_log log;
+  ngtcp2_conn_stat cstat;
+  ngtcp2_objalloc frc_objalloc;
+  ngtcp2_objalloc rtb_entry_objalloc;
+} rtb_ctx;
+
+static void rtb_ctx_init(rtb_ctx *ctx) {
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+
+  ngtcp2_objalloc_init(&ctx->frc_objalloc, 1024, mem);
+  ngtcp2_objalloc_init(&ctx->rtb_entry_objalloc, 1024, mem);
+  ngtcp2_strm_init(&ctx->crypto, 0, NGTCP2_STRM_FLAG_NONE, 0, 0, NULL,
+                   &ctx->frc_objalloc, mem);
+  memset(&ctx->cstat, 0, sizeof(ctx->cstat));
+  ctx->cstat.max_udp_payload_size = NGTCP2_MAX_UDP_PAYLOAD_SIZE;
+  ctx->cstat.cwnd = UINT64_MAX;
+  ngtcp2_rst_init(&ctx->rst);
+  ngtcp2_log_init(&ctx->log, NULL, NULL, NULL, 0, NULL);
+  ngtcp2_cc_reno_cc_init(&ctx->cc, &ctx->log, 0, 0, mem);
+  ngtcp2_rtb_init(&ctx->rtb, NGTCP2_PKTNS_ID_APPLICATION, &ctx->crypto,
+                  &ctx->rst, &ctx->cc, &ctx->log, NULL,
+                  &ctx->rtb_entry_objalloc, &ctx->frc_objalloc, mem);
+}
+
+static void rtb_ctx_free(rtb_ctx *ctx) {
+  ngtcp2_rtb_free(&ctx->rtb);
+  ngtcp2_cc_reno_cc_free(&ctx->cc, ngtcp2_mem_default());
+  ngtcp2_strm_free(&ctx->crypto);
+  ngtcp2_objalloc_free(&ctx->rtb_entry_objalloc);
+  ngtcp2_objalloc_free(&ctx->frc_objalloc);
+}
+
+/*
+ * rtb_ctx_add adds |n| packets to ctx->rtb.  Like the unit tests,
+ * ngtcp2_rtb is used without ngtcp2_conn, so the packets are not
+ * marked ack-eliciting to skip RTT update.
+ */
+static void rtb_ctx_add(rtb_ctx *ctx, size_t n) {
+  ngtcp2_pkt_hd hd;
+  ngtcp2_cid dcid;
+  ngtcp2_rtb_entry *ent;
+  size_t i;
+
+  ngtcp2_cid_zero(&dcid);
+
+  for (i = 0; i < n; ++i) {
+    ngtcp2_pkt_hd_init(&hd, NGTCP2_PKT_FLAG_NONE, NGTCP2_PKT_1RTT, &dcid, NULL,
+                       (int64_t)i, 4, NGTCP2_PROTO_VER_V1, 0);
+    check(ngtcp2_rtb_entry_objalloc_new(
+              &ent, &hd, NULL, (ngtcp2_tstamp)i, BENCH_PKTLEN,
+              NGTCP2_RTB_ENTRY_FLAG_NONE, &ctx->rtb_entry_objalloc),
+          "ngtcp2_rtb_entry_objalloc_new");
+    check(ngtcp2_rtb_add(&ctx->rtb, ent, &ctx->cstat), "ngtcp2_rtb_add");
+  }
+}
+
+static uint64_t bench_rtb_add(size_t n, uint64_t *pops) {
+  rtb_ctx ctx;
+  uint64_t t;
+
+  rtb_ctx_init(&ctx);
+
+  t = timestamp_ns();
+  rtb_ctx_add(&ctx, n);
+  t = timestamp_ns() - t;
+
+  rtb_ctx_free(&ctx);
+
+  *pops = n;
+
+  return t;
+}
+
+/*
+ * bench_rtb_recv_ack acknowledges |n| in-flight packets with ACK
+ * frames which each cover 64 packets.  1% of packets are reported
+ * missing, so ACK frames carry gaps and the unacknowledged entries
+ * stay in ngtcp2_rtb.
+ */
+static uint64_t bench_rtb_recv_ack(size_t n, uint64_t *pops) {
+  rtb_ctx ctx;
+  union {
+    ngtcp2_ack ack;
+    uint8_t buf[sizeof(ngtcp2_ack) +
+                sizeof(ngtcp2_ack_blk) * (NGTCP2_MAX_ACK_BLKS - 1)];
+  } fr;
+  uint8_t *missing = xmalloc(n);
+  ngtcp2_ssize nacked;
+  uint64_t t, total = 0;
+  size_t i, j, end, lo;
+  int64_t hi;
+
+  rtb_ctx_init(&ctx);
+  rtb_ctx_add(&ctx, n);
+
+  for (i = 0; i < n; ++i) {
+    missing[i] = bench_rand() % 100 == 0;
+  }
+
+  memset(&fr, 0, sizeof(fr));
+
+  t = timestamp_ns();
+  for (i = 0; i < n; i = end) {
+    end = ngtcp2_min(i + 64, n);
+
+    /* Encode [i, end) excluding missing packets from largest to
+       smallest. */
+    fr.ack.num_blks = 0;
+    hi = -1;
+    for (j = end; j > i;) {
+      for (; j > i && missing[j - 1]; --j)
+        ;
+      if (j == i) {
+        break;
+      }
+
+      lo = j;
+      for (; lo > i && !missing[lo - 1]; --lo)
+        ;
+
+      if (hi == -1) {
+        fr.ack.largest_ack = (int64_t)j - 1;
+        fr.ack.first_ack_blklen = (uint64_t)(j - 1 - lo);
+      } else {
+        fr.ack.blks[fr.ack.num_blks].gap = (uint64_t)(hi - (int64_t)j - 1);
+        fr.ack.blks[fr.ack.num_blks].blklen = (uint64_t)(j - 1 - lo);
+        ++fr.ack.num_blks;
+      }
+
+      hi = (int64_t)lo;
+      j = lo;
+    }
+
+    if (hi == -1) {
+      continue;
+    }
+
+    nacked =
+        ngtcp2_rtb_recv_ack(&ctx.rtb, &fr.ack, &ctx.cstat, NULL, NULL,
+                            (ngtcp2_tstamp)(n + i), (ngtcp2_tstamp)(n + i));
+    if (nacked < 0) {
+      check((int)nacked, "ngtcp2_rtb_recv_ack");
+    }
+
+    total += (uint64_t)nacked;
+  }
+  t = timestamp_ns() - t;
+
+  rtb_ctx_free(&ctx);
+  free(missing);
+
+  *pops = total;
+
+  return t;
+}
+
+/*
+ * bench_window_filter_update feeds |n| bandwidth samples which go up
+ * and down randomly to ngtcp2_window_filter as ngtcp2_rst does on
+ * every ACK.  The round advances every 8 samples.
+ */
+static uint64_t bench_window_filter_update(size_t n, uint64_t *pops) {
+  ngtcp2_window_filter wf;
+  uint64_t *samples = xmalloc(sizeof(samples[0]) * n);
+  uint64_t t, sum = 0;
+  size_t i;
+
+  for (i = 0; i < n; ++i) {
+    samples[i] = 10000000 + bench_rand() % 1000000;
+  }
+
+  ngtcp2_window_filter_init(&wf, 12);
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    ngtcp2_window_filter_update(&wf, samples[i], i / 8);
+    sum += ngtcp2_window_filter_get_best(&wf);
+  }
+  t = timestamp_ns() - t;
+
+  assert(sum);
+
+  free(samples);
+
+  *pops = n;
+
+  return t;
+}
+
+/* BENCH_CC_WINDOW is the maximum number of packets in flight in
+   bench_cc_ack. */
+#define BENCH_CC_WINDOW 4096
+/* BENCH_CC_ACK_INTERVAL is the minimum interval between ACKs in
+   bench_cc_ack.  An ACK acknowledges 2 packets, so that the bottleneck
+   bandwidth is 100Mbps. */
+#define BENCH_CC_ACK_INTERVAL                                                  \
+  (2 * BENCH_PKTLEN * 8 * NGTCP2_SECONDS / 100000000)
+/* BENCH_CC_RTT is the propagation delay of the path in bench_cc_ack. */
+#define BENCH_CC_RTT (20 * NGTCP2_MILLISECONDS)
+
+static void cc_rand(uint8_t *dest, size_t destlen,
+                    const ngtcp2_rand_ctx *rand_ctx) {
+  size_t i;
+  (void)rand_ctx;
+
+  for (i = 0; i < destlen; ++i) {
+    dest[i] = (uint8_t)bench_rand();
+  }
+}
+
+/*
+ * bench_cc_ack runs |n| ACKs through the congestion controller
+ * |cc_algo| in the way ngtcp2_rtb does: every ACK acknowledges 2
+ * packets, updates the rate sample and RTT, and the sender fills cwnd
+ * again.  An ACK arrives BENCH_CC_RTT after the packet is sent at the
+ * earliest, and no sooner than BENCH_CC_ACK_INTERVAL after the
+ * previous one, so that the packets which exceed BDP queue up and
+ * increase RTT.  1% of ACKs also report the loss of the oldest packet
+ * in flight.
+ */
+static uint64_t bench_cc_ack(ngtcp2_cc_algo cc_algo, size_t n,
+                             uint64_t *pops) {
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  ngtcp2_rtb_entry *ents = xmalloc(sizeof(ents[0]) * BENCH_CC_WINDOW);
+  ngtcp2_rtb_entry *ent, *lost_ent;
+  ngtcp2_log log;
+  ngtcp2_rst rst;
+  ngtcp2_cc cc;
+  ngtcp2_cc_ack ack;
+  ngtcp2_cc_pkt pkt;
+  ngtcp2_conn_stat cstat;
+  ngtcp2_rand_ctx rand_ctx = {0};
+  ngtcp2_tstamp ts = NGTCP2_SECONDS;
+  int64_t head = 0, next_pkt_num = 0;
+  uint64_t t;
+  size_t i, j;
+
+  ngtcp2_log_init(&log, NULL, NULL, NULL, 0, NULL);
+  ngtcp2_rst_init(&rst);
+
+  memset(&cstat, 0, sizeof(cstat));
+  cstat.max_udp_payload_size = BENCH_PKTLEN;
+  cstat.cwnd = 10 * BENCH_PKTLEN;
+  cstat.ssthresh = UINT64_MAX;
+  cstat.min_rtt = UINT64_MAX;
+  cstat.initial_rtt = NGTCP2_DEFAULT_INITIAL_RTT;
+  cstat.smoothed_rtt = NGTCP2_DEFAULT_INITIAL_RTT;
+  cstat.rttvar = NGTCP2_DEFAULT_INITIAL_RTT / 2;
+  cstat.send_quantum = SIZE_MAX;
+
+  switch (cc_algo) {
+  case NGTCP2_CC_ALGO_RENO:
+    check(ngtcp2_cc_reno_cc_init(&cc, &log, /* hystart = */ 1,
+                                 /* cwnd_validation = */ 0, mem),
+          "ngtcp2_cc_reno_cc_init");
+    break;
+  case NGTCP2_CC_ALGO_CUBIC:
+    check(ngtcp2_cc_cubic_cc_init(&cc, &log, /* hystart = */ 1,
+                                  /* cwnd_validation = */ 0, mem),
+          "ngtcp2_cc_cubic_cc_init");
+    break;
+  case NGTCP2_CC_ALGO_BBR:
+    check(ngtcp2_cc_bbr_cc_init(&cc, &log, &cstat, &rst, ts, cc_rand,
+                                &rand_ctx, mem),
+          "ngtcp2_cc_bbr_cc_init");
+    break;
+  case NGTCP2_CC_ALGO_BBR2:
+    check(ngtcp2_cc_bbr2_cc_init(&cc, &log, &cstat, &rst, ts, cc_rand,
+                                 &rand_ctx, mem),
+          "ngtcp2_cc_bbr2_cc_init");
+    break;
+  default:
+    assert(0);
+    abort();
+  }
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    /* Fill cwnd. */
+    for (; next_pkt_num - head < BENCH_CC_WINDOW &&
+           cstat.bytes_in_flight + BENCH_PKTLEN <= cstat.cwnd;
+         ++next_pkt_num) {
+      ent = &ents[next_pkt_num % BENCH_CC_WINDOW];
+      memset(ent, 0, sizeof(*ent));
+      ent->hd.pkt_num = next_pkt_num;
+      ent->ts = ts;
+      ent->pktlen = BENCH_PKTLEN;
+
+      ngtcp2_rst_on_pkt_sent(&rst, ent, &cstat);
+      cstat.bytes_in_flight += BENCH_PKTLEN;
+
+      if (cc.on_pkt_sent) {
+        cc.on_pkt_sent(&cc, &cstat,
+                       ngtcp2_cc_pkt_init(&pkt, ent->hd.pkt_num, ent->pktlen,
+                                          NGTCP2_PKTNS_ID_APPLICATION, ts,
+                                          ent->rst.lost,
+                                          ent->rst.tx_in_flight,
+                                          ent->rst.is_app_limited));
+      }
+    }
+
+    memset(&ack, 0, sizeof(ack));
+    ack.prior_bytes_in_flight = cstat.bytes_in_flight;
+
+    lost_ent = NULL;
+
+    if (bench_rand() % 100 == 0 && next_pkt_num - head > 2) {
+      lost_ent = &ents[head++ % BENCH_CC_WINDOW];
+    }
+
+    ent = &ents[ngtcp2_min(head + 1, next_pkt_num - 1) % BENCH_CC_WINDOW];
+    ts = ngtcp2_max(ts + BENCH_CC_ACK_INTERVAL, ent->ts + BENCH_CC_RTT);
+
+    if (lost_ent) {
+      cstat.bytes_in_flight -= lost_ent->pktlen;
+      ack.bytes_lost = lost_ent->pktlen;
+
+      if (cc.on_pkt_lost) {
+        cc.on_pkt_lost(
+            &cc, &cstat,
+            ngtcp2_cc_pkt_init(&pkt, lost_ent->hd.pkt_num, lost_ent->pktlen,
+                               NGTCP2_PKTNS_ID_APPLICATION, lost_ent->ts,
+                               lost_ent->rst.lost, lost_ent->rst.tx_in_flight,
+                               lost_ent->rst.is_app_limited),
+            ts);
+      }
+
+      cc.congestion_event(&cc, &cstat, lost_ent->ts, ts);
+    }
+
+    ack.rtt = ts - ent->ts;
+    cstat.latest_rtt = ack.rtt;
+    cstat.min_rtt = ngtcp2_min(cstat.min_rtt, ack.rtt);
+    cstat.smoothed_rtt = (cstat.smoothed_rtt * 7 + ack.rtt) / 8;
+
+    if (cc.new_rtt_sample) {
+      cc.new_rtt_sample(&cc, &cstat, ts);
+    }
+
+    for (j = 0; j < 2 && head < next_pkt_num; ++j) {
+      ent = &ents[head++ % BENCH_CC_WINDOW];
+
+      ngtcp2_rst_update_rate_sample(&rst, ent, ts);
+      cstat.bytes_in_flight -= ent->pktlen;
+      ack.bytes_delivered += ent->pktlen;
+      ack.pkt_delivered = ent->rst.delivered;
+      ack.largest_acked_sent_ts = ent->ts;
+
+      cc.on_pkt_acked(&cc, &cstat,
+                      ngtcp2_cc_pkt_init(&pkt, ent->hd.pkt_num, ent->pktlen,
+                                         NGTCP2_PKTNS_ID_APPLICATION, ent->ts,
+                                         ent->rst.lost, ent->rst.tx_in_flight,
+                                         ent->rst.is_app_limited),
+                      ts);
+    }
+
+    check(ngtcp2_rst_on_ack_recv(&rst, &cstat, ack.pkt_delivered),
+          "ngtcp2_rst_on_ack_recv");
+    rst.lost += ack.bytes_lost;
+
+    cc.on_ack_recv(&cc, &cstat, &ack, ts);
+  }
+  t = timestamp_ns() - t;
+
+  switch (cc_algo) {
+  case NGTCP2_CC_ALGO_RENO:
+    ngtcp2_cc_reno_cc_free(&cc, mem);
+    break;
+  case NGTCP2_CC_ALGO_CUBIC:
+    ngtcp2_cc_cubic_cc_free(&cc, mem);
+    break;
+  case NGTCP2_CC_ALGO_BBR:
+    ngtcp2_cc_bbr_cc_free(&cc, mem);
+    break;
+  case NGTCP2_CC_ALGO_BBR2:
+    ngtcp2_cc_bbr2_cc_free(&cc, mem);
+    break;
+  default:
+    assert(0);
+  }
+
+  free(ents);
+
+  *pops = n;
+
+  return t;
+}
+
+static uint64_t bench_cc_ack_reno(size_t n, uint64_t *pops) {
+  return bench_cc_ack(NGTCP2_CC_ALGO_RENO, n, pops);
+}
+
+static uint64_t bench_cc_ack_cubic(size_t n, uint64_t *pops) {
+  return bench_cc_ack(NGTCP2_CC_ALGO_CUBIC, n, pops);
+}
+
+static uint64_t bench_cc_ack_bbr(size_t n, uint64_t *pops) {
+  return bench_cc_ack(NGTCP2_CC_ALGO_BBR, n, pops);
+}
+
+static uint64_t bench_cc_ack_bbr2(size_t n, uint64_t *pops) {
+  return bench_cc_ack(NGTCP2_CC_ALGO_BBR2, n, pops);
+}
+
+/*
+ * bench_decode_ack decodes |n| ACK frames which carry 64 ACK Ranges
+ * of random sizes, like the ones a high-rate receiver sends under
+ * loss, and reads all ranges as ngtcp2_rtb_recv_ack does.
+ */
+static uint64_t bench_decode_ack(size_t n, uint64_t *pops) {
+  union {
+    ngtcp2_ack ack;
+    uint8_t buf[sizeof(ngtcp2_ack) +
+                sizeof(ngtcp2_ack_blk) * (NGTCP2_MAX_ACK_BLKS - 1)];
+  } fr;
+  uint8_t buf[2048];
+  uint8_t *p;
+  size_t i, len;
+  ngtcp2_ssize nread;
+  ngtcp2_ack_range_it it;
+  ngtcp2_ack_blk blk;
+  uint64_t t, sum = 0;
+
+  p = buf;
+  *p++ = NGTCP2_FRAME_ACK_ECN;
+  p = ngtcp2_put_varint(p, 1000000000);
+  p = ngtcp2_put_varint(p, 25000);
+  p = ngtcp2_put_varint(p, 64);
+  p = ngtcp2_put_varint(p, bench_rand() % 100);
+
+  for (i = 0; i < 64 * 2; ++i) {
+    p = ngtcp2_put_varint(p, bench_rand() % (i % 4 == 0 ? 100000 : 60));
+  }
+
+  for (i = 0; i < 3; ++i) {
+    p = ngtcp2_put_varint(p, bench_rand() % 1000000);
+  }
+
+  len = (size_t)(p - buf);
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    nread = ngtcp2_pkt_decode_ack_frame(&fr.ack, buf, len);
+    if (nread < 0) {
+      check((int)nread, "ngtcp2_pkt_decode_ack_frame");
+    }
+
+    ngtcp2_ack_range_it_init(&it, &fr.ack);
+
+    while (ngtcp2_ack_range_it_next(&it, &blk)) {
+      sum += blk.blklen;
+    }
+  }
+  t = timestamp_ns() - t;
+
+  /* Keep the decoding from being optimized out. */
+  if (sum == UINT64_MAX) {
+    fprintf(stderr, "bench: %" PRIu64 "\n", sum);
+  }
+
+  *pops = n;
+
+  return t;
+}
+
+/*
+ * bench_decode_stream decodes |n| STREAM frame headers which carry
+ * Offset and Length.
+ */
+static uint64_t bench_decode_stream(size_t n, uint64_t *pops) {
+  union {
+    ngtcp2_stream fr;
+    uint8_t buf[sizeof(ngtcp2_stream) + sizeof(ngtcp2_vec)];
+  } fr;
+  uint8_t buf[BENCH_PKTLEN];
+  uint8_t *p;
+  size_t i;
+  ngtcp2_ssize nread;
+  uint64_t t, sum = 0;
+
+  memset(buf, 0, sizeof(buf));
+
+  p = buf;
+  *p++ = NGTCP2_FRAME_STREAM | NGTCP2_STREAM_OFF_BIT | NGTCP2_STREAM_LEN_BIT;
+  p = ngtcp2_put_varint(p, 4);
+  p = ngtcp2_put_varint(p, 1 << 24);
+  ngtcp2_put_varint(p, 1000);
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    nread = ngtcp2_pkt_decode_stream_frame(&fr.fr, buf, sizeof(buf));
+    if (nread < 0) {
+      check((int)nread, "ngtcp2_pkt_decode_stream_frame");
+    }
+
+    sum += fr.fr.offset;
+  }
+  t = timestamp_ns() - t;
+
+  if (sum == UINT64_MAX) {
+    fprintf(stderr, "bench: %" PRIu64 "\n", sum);
+  }
+
+  *pops = n;
+
+  return t;
+}
+
+/* BENCH_NFRAME_SAMPLE is the number of sample frames which the frame
+   encoding and decoding benchmarks cycle through, so that the varints
+   of various lengths are exercised. */
+#define BENCH_NFRAME_SAMPLE 16
+
+static const uint8_t bench_frame_data[BENCH_PKTLEN];
+
+/*
+ * bench_frame_sample initializes |fr| with a frame of type |type|
+ * which carries random but realistic values.
+ */
+static void bench_frame_sample(ngtcp2_max_frame *mfr, uint64_t type) {
+  ngtcp2_frame *fr = &mfr->fr;
+  size_t i;
+
+  memset(mfr, 0, sizeof(*mfr));
+
+  switch (type) {
+  case NGTCP2_FRAME_PADDING:
+    fr->padding.type = NGTCP2_FRAME_PADDING;
+    fr->padding.len = 1 + bench_rand() % 64;
+    break;
+  case NGTCP2_FRAME_PING:
+  case NGTCP2_FRAME_HANDSHAKE_DONE:
+  case NGTCP2_FRAME_IMMEDIATE_ACK:
+    fr->type = (uint8_t)type;
+    break;
+  case NGTCP2_FRAME_ACK:
+  case NGTCP2_FRAME_ACK_ECN:
+    /* Large ACK frame of a high-rate receiver under loss */
+    fr->ack.type = (uint8_t)type;
+    fr->ack.largest_ack = (int64_t)(1000000000 + bench_rand() % 1000000);
+    fr->ack.ack_delay = bench_rand() % 25000;
+    fr->ack.first_ack_blklen = bench_rand() % 100;
+    fr->ack.num_blks = NGTCP2_MAX_ACK_BLKS;
+
+    for (i = 0; i < NGTCP2_MAX_ACK_BLKS; ++i) {
+      fr->ack.blks[i].gap = bench_rand() % 4;
+      fr->ack.blks[i].blklen = bench_rand() % 60;
+    }
+
+    if (type == NGTCP2_FRAME_ACK_ECN) {
+      fr->ack.ecn.ect0 = bench_rand() % 1000000000;
+      fr->ack.ecn.ect1 = 0;
+      fr->ack.ecn.ce = bench_rand() % 1000;
+    }
+    break;
+  case NGTCP2_FRAME_RESET_STREAM:
+    fr->reset_stream.type = NGTCP2_FRAME_RESET_STREAM;
+    fr->reset_stream.stream_id = (int64_t)(bench_rand() % 100000 * 4);
+    fr->reset_stream.app_error_code = bench_rand() % 0x1000;
+    fr->reset_stream.final_size = bench_rand() % (1llu << 32);
+    break;
+  case NGTCP2_FRAME_STOP_SENDING:
+    fr->stop_sending.type = NGTCP2_FRAME_STOP_SENDING;
+    fr->stop_sending.stream_id = (int64_t)(bench_rand() % 100000 * 4);
+    fr->stop_sending.app_error_code = bench_rand() % 0x1000;
+    break;
+  case NGTCP2_FRAME_CRYPTO:
+    fr->crypto.type = NGTCP2_FRAME_CRYPTO;
+    fr->crypto.offset = bench_rand() % 16384;
+    fr->crypto.datacnt = 1;
+    fr->crypto.data[0].base = (uint8_t *)bench_frame_data;
+    fr->crypto.data[0].len = 1 + bench_rand() % 1100;
+    break;
+  case NGTCP2_FRAME_NEW_TOKEN:
+    fr->new_token.type = NGTCP2_FRAME_NEW_TOKEN;
+    fr->new_token.token.base = (uint8_t *)bench_frame_data;
+    fr->new_token.token.len = 64;
+    break;
+  case NGTCP2_FRAME_STREAM:
+    fr->stream.type = NGTCP2_FRAME_STREAM;
+    fr->stream.stream_id = (int64_t)(bench_rand() % 100000 * 4);
+    fr->stream.offset = bench_rand() % (1llu << (bench_rand() % 40));
+    fr->stream.fin = bench_rand() % 8 == 0;
+    fr->stream.datacnt = 1;
+    fr->stream.data[0].base = (uint8_t *)bench_frame_data;
+    fr->stream.data[0].len = 1 + bench_rand() % 1100;
+    break;
+  case NGTCP2_FRAME_MAX_DATA:
+    fr->max_data.type = NGTCP2_FRAME_MAX_DATA;
+    fr->max_data.max_data = bench_rand() % (1llu << 40);
+    break;
+  case NGTCP2_FRAME_MAX_STREAM_DATA:
+    fr->max_stream_data.type = NGTCP2_FRAME_MAX_STREAM_DATA;
+    fr->max_stream_data.stream_id = (int64_t)(bench_rand() % 100000 * 4);
+    fr->max_stream_data.max_stream_data = bench_rand() % (1llu << 32);
+    break;
+  case NGTCP2_FRAME_MAX_STREAMS_BIDI:
+    fr->max_streams.type = NGTCP2_FRAME_MAX_STREAMS_BIDI;
+    fr->max_streams.max_streams = bench_rand() % 100000;
+    break;
+  case NGTCP2_FRAME_DATA_BLOCKED:
+    fr->data_blocked.type = NGTCP2_FRAME_DATA_BLOCKED;
+    fr->data_blocked.offset = bench_rand() % (1llu << 40);
+    break;
+  case NGTCP2_FRAME_STREAM_DATA_BLOCKED:
+    fr->stream_data_blocked.type = NGTCP2_FRAME_STREAM_DATA_BLOCKED;
+    fr->stream_data_blocked.stream_id = (int64_t)(bench_rand() % 100000 * 4);
+    fr->stream_data_blocked.offset = bench_rand() % (1llu << 32);
+    break;
+  case NGTCP2_FRAME_STREAMS_BLOCKED_BIDI:
+    fr->streams_blocked.type = NGTCP2_FRAME_STREAMS_BLOCKED_BIDI;
+    fr->streams_blocked.max_streams = bench_rand() % 100000;
+    break;
+  case NGTCP2_FRAME_NEW_CONNECTION_ID:
+    fr->new_connection_id.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+    fr->new_connection_id.seq = bench_rand() % 1000;
+    fr->new_connection_id.retire_prior_to = fr->new_connection_id.seq / 2;
+    fr->new_connection_id.cid.datalen = NGTCP2_MAX_CIDLEN;
+
+    for (i = 0; i < NGTCP2_MAX_CIDLEN; ++i) {
+      fr->new_connection_id.cid.data[i] = (uint8_t)bench_rand();
+    }
+
+    for (i = 0; i < NGTCP2_STATELESS_RESET_TOKENLEN; ++i) {
+      fr->new_connection_id.stateless_reset_token[i] = (uint8_t)bench_rand();
+    }
+    break;
+  case NGTCP2_FRAME_RETIRE_CONNECTION_ID:
+    fr->retire_connection_id.type = NGTCP2_FRAME_RETIRE_CONNECTION_ID;
+    fr->retire_connection_id.seq = bench_rand() % 1000;
+    break;
+  case NGTCP2_FRAME_PATH_CHALLENGE:
+  case NGTCP2_FRAME_PATH_RESPONSE:
+    fr->path_challenge.type = (uint8_t)type;
+
+    for (i = 0; i < NGTCP2_PATH_CHALLENGE_DATALEN; ++i) {
+      fr->path_challenge.data[i] = (uint8_t)bench_rand();
+    }
+    break;
+  case NGTCP2_FRAME_CONNECTION_CLOSE:
+    fr->connection_close.type = NGTCP2_FRAME_CONNECTION_CLOSE;
+    fr->connection_close.error_code = NGTCP2_PROTOCOL_VIOLATION;
+    fr->connection_close.frame_type = NGTCP2_FRAME_STREAM;
+    fr->connection_close.reasonlen = 32;
+    fr->connection_close.reason = (uint8_t *)bench_frame_data;
+    break;
+  case NGTCP2_FRAME_DATAGRAM_LEN:
+    fr->datagram.type = NGTCP2_FRAME_DATAGRAM_LEN;
+    fr->datagram.datacnt = 1;
+    fr->datagram.data = fr->datagram.rdata;
+    fr->datagram.rdata[0].base = (uint8_t *)bench_frame_data;
+    fr->datagram.rdata[0].len = 1 + bench_rand() % 1100;
+    break;
+  case NGTCP2_FRAME_ACK_FREQUENCY:
+    fr->ack_frequency.type = NGTCP2_FRAME_ACK_FREQUENCY;
+    fr->ack_frequency.seq = bench_rand() % 1000;
+    fr->ack_frequency.ack_eliciting_threshold = bench_rand() % 10;
+    fr->ack_frequency.request_max_ack_delay = bench_rand() % 100000;
+    fr->ack_frequency.reordering_threshold = bench_rand() % 4;
+    break;
+  case NGTCP2_FRAME_REPAIR:
+    fr->repair.type = NGTCP2_FRAME_REPAIR;
+    fr->repair.stream_id = (int64_t)(bench_rand() % 100000 * 4);
+    fr->repair.offset = bench_rand() % (1llu << 32);
+    fr->repair.symbolcnt = 1 + bench_rand() % NGTCP2_MAX_FEC_SYMBOLCNT;
+
+    for (i = 0; i < fr->repair.symbolcnt; ++i) {
+      fr->repair.symbollen[i] = (uint16_t)(1 + bench_rand() % 1100);
+    }
+
+    fr->repair.data.base = (uint8_t *)bench_frame_data;
+    fr->repair.data.len = 1100;
+    break;
+  default:
+    assert(0);
+    abort();
+  }
+}
+
+/*
+ * bench_frame_encode encodes |n| frames of type |type| with
+ * ngtcp2_pkt_encode_frame.
+ */
+static uint64_t bench_frame_encode(uint64_t type, size_t n, uint64_t *pops) {
+  ngtcp2_max_frame frs[BENCH_NFRAME_SAMPLE];
+  uint8_t buf[BENCH_PKTLEN * 2];
+  size_t i;
+  ngtcp2_ssize nwrite;
+  uint64_t t, sum = 0;
+
+  for (i = 0; i < BENCH_NFRAME_SAMPLE; ++i) {
+    bench_frame_sample(&frs[i], type);
+  }
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    nwrite = ngtcp2_pkt_encode_frame(buf, sizeof(buf),
+                                     &frs[i % BENCH_NFRAME_SAMPLE].fr);
+    if (nwrite < 0) {
+      check((int)nwrite, "ngtcp2_pkt_encode_frame");
+    }
+
+    sum += (uint64_t)nwrite + buf[0];
+  }
+  t = timestamp_ns() - t;
+
+  if (sum == UINT64_MAX) {
+    fprintf(stderr, "bench: %" PRIu64 "\n", sum);
+  }
+
+  *pops = n;
+
+  return t;
+}
+
+/*
+ * bench_frame_decode decodes |n| frames of type |type| with
+ * ngtcp2_pkt_decode_frame as ngtcp2_conn_read_pkt does.
+ */
+static uint64_t bench_frame_decode(uint64_t type, size_t n, uint64_t *pops) {
+  ngtcp2_max_frame mfr;
+  uint8_t *bufs;
+  size_t lens[BENCH_NFRAME_SAMPLE];
+  size_t i, bufsize = BENCH_PKTLEN * 2;
+  ngtcp2_ssize nread;
+  uint64_t t, sum = 0;
+
+  bufs = xmalloc(bufsize * BENCH_NFRAME_SAMPLE);
+
+  for (i = 0; i < BENCH_NFRAME_SAMPLE; ++i) {
+    bench_frame_sample(&mfr, type);
+
+    nread = ngtcp2_pkt_encode_frame(bufs + bufsize * i, bufsize, &mfr.fr);
+    if (nread < 0) {
+      check((int)nread, "ngtcp2_pkt_encode_frame");
+    }
+
+    lens[i] = (size_t)nread;
+  }
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    nread = ngtcp2_pkt_decode_frame(
+        &mfr.fr, bufs + bufsize * (i % BENCH_NFRAME_SAMPLE),
+        lens[i % BENCH_NFRAME_SAMPLE]);
+    if (nread < 0) {
+      check((int)nread, "ngtcp2_pkt_decode_frame");
+    }
+
+    sum += (uint64_t)nread + mfr.fr.type;
+  }
+  t = timestamp_ns() - t;
+
+  if (sum == UINT64_MAX) {
+    fprintf(stderr, "bench: %" PRIu64 "\n", sum);
+  }
+
+  free(bufs);
+
+  *pops = n;
+
+  return t;
+}
+
+/*
+ * BENCH_FRAME defines bench_frame_encode_NAME and
+ * bench_frame_decode_NAME which measure the frame of type |TYPE|.
+ */
+#define BENCH_FRAME(NAME, TYPE)                                                \
+  static uint64_t bench_frame_encode_##NAME(size_t n, uint64_t *pops) {        \
+    return bench_frame_encode((TYPE), n, pops);                                \
+  }                                                                            \
+                                                                               \
+  static uint64_t bench_frame_decode_##NAME(size_t n, uint64_t *pops) {        \
+    return bench_frame_decode((TYPE), n, pops);                                \
+  }
+
+BENCH_FRAME(padding, NGTCP2_FRAME_PADDING)
+BENCH_FRAME(ping, NGTCP2_FRAME_PING)
+BENCH_FRAME(ack, NGTCP2_FRAME_ACK)
+BENCH_FRAME(ack_ecn, NGTCP2_FRAME_ACK_ECN)
+BENCH_FRAME(reset_stream, NGTCP2_FRAME_RESET_STREAM)
+BENCH_FRAME(stop_sending, NGTCP2_FRAME_STOP_SENDING)
+BENCH_FRAME(crypto, NGTCP2_FRAME_CRYPTO)
+BENCH_FRAME(new_token, NGTCP2_FRAME_NEW_TOKEN)
+BENCH_FRAME(stream, NGTCP2_FRAME_STREAM)
+BENCH_FRAME(max_data, NGTCP2_FRAME_MAX_DATA)
+BENCH_FRAME(max_stream_data, NGTCP2_FRAME_MAX_STREAM_DATA)
+BENCH_FRAME(max_streams, NGTCP2_FRAME_MAX_STREAMS_BIDI)
+BENCH_FRAME(data_blocked, NGTCP2_FRAME_DATA_BLOCKED)
+BENCH_FRAME(stream_data_blocked, NGTCP2_FRAME_STREAM_DATA_BLOCKED)
+BENCH_FRAME(streams_blocked, NGTCP2_FRAME_STREAMS_BLOCKED_BIDI)
+BENCH_FRAME(new_connection_id, NGTCP2_FRAME_NEW_CONNECTION_ID)
+BENCH_FRAME(retire_connection_id, NGTCP2_FRAME_RETIRE_CONNECTION_ID)
+BENCH_FRAME(path_challenge, NGTCP2_FRAME_PATH_CHALLENGE)
+BENCH_FRAME(path_response, NGTCP2_FRAME_PATH_RESPONSE)
+BENCH_FRAME(connection_close, NGTCP2_FRAME_CONNECTION_CLOSE)
+BENCH_FRAME(handshake_done, NGTCP2_FRAME_HANDSHAKE_DONE)
+BENCH_FRAME(datagram, NGTCP2_FRAME_DATAGRAM_LEN)
+BENCH_FRAME(ack_frequency, NGTCP2_FRAME_ACK_FREQUENCY)
+BENCH_FRAME(immediate_ack, NGTCP2_FRAME_IMMEDIATE_ACK)
+BENCH_FRAME(repair, NGTCP2_FRAME_REPAIR)
+
+static int conn_null_encrypt(uint8_t *dest, const ngtcp2_crypto_aead *aead,
+                             const ngtcp2_crypto_aead_ctx *aead_ctx,
+                             const uint8_t *plaintext, size_t plaintextlen,
+                             const uint8_t *nonce, size_t noncelen,
+                             const uint8_t *aad, size_t aadlen) {
+  (void)aead;
+  (void)aead_ctx;
+  (void)nonce;
+  (void)noncelen;
+  (void)aad;
+  (void)aadlen;
+
+  if (plaintextlen && plaintext != dest) {
+    memmove(dest, plaintext, plaintextlen);
+  }
+  memset(dest + plaintextlen, 0, NGTCP2_INITIAL_AEAD_OVERHEAD);
+
+  return 0;
+}
+
+static int conn_null_decrypt(uint8_t *dest, const ngtcp2_crypto_aead *aead,
+                             const ngtcp2_crypto_aead_ctx *aead_ctx,
+                             const uint8_t *ciphertext, size_t ciphertextlen,
+                             const uint8_t *nonce, size_t noncelen,
+                             const uint8_t *aad, size_t aadlen) {
+  (void)aead;
+  (void)aead_ctx;
+  (void)nonce;
+  (void)noncelen;
+  (void)aad;
+  (void)aadlen;
+
+  memmove(dest, ciphertext, ciphertextlen - NGTCP2_INITIAL_AEAD_OVERHEAD);
+
+  return 0;
+}
+
+static int conn_null_hp_mask(uint8_t *dest, const ngtcp2_crypto_cipher *hp,
+                             const ngtcp2_crypto_cipher_ctx *hp_ctx,
+                             const uint8_t *sample) {
+  (void)hp;
+  (void)hp_ctx;
+  (void)sample;
+
+  memset(dest, 0, NGTCP2_HP_MASKLEN);
+
+  return 0;
+}
+
+static int conn_client_initial(ngtcp2_conn *conn, void *user_data) {
+  (void)conn;
+  (void)user_data;
+
+  return 0;
+}
+
+static int conn_recv_crypto_data(ngtcp2_conn *conn,
+                                 ngtcp2_crypto_level crypto_level,
+                                 uint64_t offset, const uint8_t *data,
+                                 size_t datalen, void *user_data) {
+  (void)conn;
+  (void)crypto_level;
+  (void)offset;
+  (void)data;
+  (void)datalen;
+  (void)user_data;
+
+  return 0;
+}
+
+static int conn_recv_retry(ngtcp2_conn *conn, const ngtcp2_pkt_hd *hd,
+                           void *user_data) {
+  (void)conn;
+  (void)hd;
+  (void)user_data;
+
+  return 0;
+}
+
+static void conn_rand(uint8_t *dest, size_t destlen,
+                      const ngtcp2_rand_ctx *rand_ctx) {
+  size_t i;
+  (void)rand_ctx;
+
+  for (i = 0; i < destlen; ++i) {
+    dest[i] = (uint8_t)bench_rand();
+  }
+}
+
+static int conn_get_new_connection_id(ngtcp2_conn *conn, ngtcp2_cid *cid,
+                                      uint8_t *token, size_t cidlen,
+                                      void *user_data) {
+  (void)conn;
+  (void)user_data;
+
+  conn_rand(cid->data, cidlen, NULL);
+  cid->datalen = cidlen;
+  conn_rand(token, NGTCP2_STATELESS_RESET_TOKENLEN, NULL);
+
+  return 0;
+}
+
+static int conn_update_key(ngtcp2_conn *conn, uint8_t *rx_secret,
+                           uint8_t *tx_secret,
+                           ngtcp2_crypto_aead_ctx *rx_aead_ctx, uint8_t *rx_iv,
+                           ngtcp2_crypto_aead_ctx *tx_aead_ctx, uint8_t *tx_iv,
+                           const uint8_t *current_rx_secret,
+                           const uint8_t *current_tx_secret, size_t secretlen,
+                           void *user_data) {
+  (void)conn;
+  (void)current_rx_secret;
+  (void)current_tx_secret;
+  (void)user_data;
+
+  memset(rx_secret, 0xff, secretlen);
+  memset(tx_secret, 0xff, secretlen);
+  rx_aead_ctx->native_handle = NULL;
+  memset(rx_iv, 0xff, 16);
+  tx_aead_ctx->native_handle = NULL;
+  memset(tx_iv, 0xff, 16);
+
+  return 0;
+}
+
+static void conn_delete_crypto_aead_ctx(ngtcp2_conn *conn,
+                                        ngtcp2_crypto_aead_ctx *aead_ctx,
+                                        void *user_data) {
+  (void)conn;
+  (void)aead_ctx;
+  (void)user_data;
+}
+
+static void conn_delete_crypto_cipher_ctx(ngtcp2_conn *conn,
+                                          ngtcp2_crypto_cipher_ctx *cipher_ctx,
+                                          void *user_data) {
+  (void)conn;
+  (void)cipher_ctx;
+  (void)user_data;
+}
+
+static int conn_get_path_challenge_data(ngtcp2_conn *conn, uint8_t *data,
+                                        void *user_data) {
+  (void)conn;
+  (void)user_data;
+
+  conn_rand(data, NGTCP2_PATH_CHALLENGE_DATALEN, NULL);
+
+  return 0;
+}
+
+static int conn_recv_client_initial(ngtcp2_conn *conn, const ngtcp2_cid *dcid,
+                                    void *user_data) {
+  (void)conn;
+  (void)dcid;
+  (void)user_data;
+
+  return 0;
+}
+
+static void conn_callbacks_init(ngtcp2_callbacks *cb) {
+  memset(cb, 0, sizeof(*cb));
+  cb->client_initial = conn_client_initial;
+  cb->recv_client_initial = conn_recv_client_initial;
+  cb->recv_crypto_data = conn_recv_crypto_data;
+  cb->recv_retry = conn_recv_retry;
+  cb->encrypt = conn_null_encrypt;
+  cb->decrypt = conn_null_decrypt;
+  cb->hp_mask = conn_null_hp_mask;
+  cb->rand = conn_rand;
+  cb->get_new_connection_id = conn_get_new_connection_id;
+  cb->update_key = conn_update_key;
+  cb->delete_crypto_aead_ctx = conn_delete_crypto_aead_ctx;
+  cb->delete_crypto_cipher_ctx = conn_delete_crypto_cipher_ctx;
+  cb->get_path_challenge_data = conn_get_path_challenge_data;
+}
+
+static void conn_transport_params_init(ngtcp2_transport_params *params) {
+  ngtcp2_transport_params_default(params);
+  params->initial_max_stream_data_bidi_local = 256 * 1024;
+  params->initial_max_data = 1024 * 1024;
+  params->initial_max_streams_bidi = 100;
+}
+
+/*
+ * conn_complete_handshake installs the null keys to |conn|, and puts
+ * it into the state where the handshake has been confirmed in the
+ * same way as the unit tests do.  |params| is used as the transport
+ * parameters of the remote endpoint.
+ */
+static void conn_complete_handshake(ngtcp2_conn *conn,
+                                    const ngtcp2_transport_params *params) {
+  static uint8_t null_secret[32];
+  static uint8_t null_iv[16];
+  ngtcp2_crypto_ctx crypto_ctx;
+  ngtcp2_crypto_aead_ctx aead_ctx = {0};
+  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
+  ngtcp2_scid *pscid;
+  ngtcp2_ksl_it it;
+
+  memset(&crypto_ctx, 0, sizeof(crypto_ctx));
+  crypto_ctx.aead.max_overhead = NGTCP2_INITIAL_AEAD_OVERHEAD;
+  crypto_ctx.max_encryption = UINT64_MAX;
+  crypto_ctx.max_decryption_failure = UINT64_MAX;
+
+  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
+  check(ngtcp2_conn_install_rx_handshake_key(conn, &aead_ctx, null_iv,
+                                             sizeof(null_iv), &hp_ctx),
+        "ngtcp2_conn_install_rx_handshake_key");
+  check(ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
+                                             sizeof(null_iv), &hp_ctx),
+        "ngtcp2_conn_install_tx_handshake_key");
+  check(ngtcp2_conn_install_rx_key(conn, null_secret, sizeof(null_secret),
+                                   &aead_ctx, null_iv, sizeof(null_iv),
+                                   &hp_ctx),
+        "ngtcp2_conn_install_rx_key");
+  check(ngtcp2_conn_install_tx_key(conn, null_secret, sizeof(null_secret),
+                                   &aead_ctx, null_iv, sizeof(null_iv),
+                                   &hp_ctx),
+        "ngtcp2_conn_install_tx_key");
+
+  conn->state = NGTCP2_CS_POST_HANDSHAKE;
+  conn->flags |= NGTCP2_CONN_FLAG_CONN_ID_NEGOTIATED |
+                 NGTCP2_CONN_FLAG_HANDSHAKE_COMPLETED |
+                 NGTCP2_CONN_FLAG_HANDSHAKE_COMPLETED_HANDLED |
+                 NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED;
+  conn->dcid.current.flags |= NGTCP2_DCID_FLAG_PATH_VALIDATED;
+
+  it = ngtcp2_ksl_begin(&conn->scid.set);
+  pscid = ngtcp2_ksl_it_get(&it);
+  pscid->flags |= NGTCP2_SCID_FLAG_USED;
+  check(ngtcp2_pq_push(&conn->scid.used, &pscid->pe), "ngtcp2_pq_push");
+
+  check(ngtcp2_transport_params_storage_copy(
+            &conn->remote.transport_params_storage[0], params, conn->mem),
+        "ngtcp2_transport_params_storage_copy");
+  conn->remote.transport_params =
+      &conn->remote.transport_params_storage[0].params;
+  conn->local.bidi.max_streams = params->initial_max_streams_bidi;
+  conn->local.uni.max_streams = params->initial_max_streams_uni;
+  conn->tx.max_offset = params->initial_max_data;
+  conn->negotiated_version = conn->client_chosen_version;
+}
+
+static void conn_path_init(ngtcp2_path_storage *ps) {
+  ngtcp2_sockaddr_in6 addr;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin6_family = NGTCP2_AF_INET6;
+  ngtcp2_path_storage_init(ps, (const ngtcp2_sockaddr *)&addr, sizeof(addr),
+                           (const ngtcp2_sockaddr *)&addr, sizeof(addr),
+                           NULL);
+}
+
+/*
+ * conn_client_new creates a client ngtcp2_conn which has already
+ * completed the handshake in the same way as the unit tests do.  It
+ * allocates memory from |mem|.
+ */
+static ngtcp2_conn *conn_client_new(const ngtcp2_mem *mem) {
+  ngtcp2_callbacks cb;
+  ngtcp2_settings settings;
+  ngtcp2_transport_params params;
+  ngtcp2_cid dcid, scid;
+  ngtcp2_path_storage ps;
+  ngtcp2_conn *conn;
+
+  conn_callbacks_init(&cb);
+
+  ngtcp2_settings_default(&settings);
+  settings.initial_ts = 0;
+  settings.no_pmtud = 1;
+  /* Count the memory usage for ngtcp2_conn_get_mem_stat. */
+  settings.mem_budget = UINT64_MAX;
+
+  conn_transport_params_init(&params);
+
+  conn_rand(dcid.data, NGTCP2_MIN_INITIAL_DCIDLEN, NULL);
+  dcid.datalen = NGTCP2_MIN_INITIAL_DCIDLEN;
+  conn_rand(scid.data, NGTCP2_MIN_INITIAL_DCIDLEN, NULL);
+  scid.datalen = NGTCP2_MIN_INITIAL_DCIDLEN;
+
+  conn_path_init(&ps);
+
+  check(ngtcp2_conn_client_new(&conn, &dcid, &scid, &ps.path,
+                               NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
+                               mem, NULL),
+        "ngtcp2_conn_client_new");
+
+  conn_complete_handshake(conn, &params);
+
+  return conn;
+}
+
+/*
+ * conn_server_new creates a server ngtcp2_conn which has already
+ * completed the handshake in the same way as the unit tests do.  It
+ * allocates memory from |mem|.  The time spent in
+ * ngtcp2_conn_server_new is added to |*pns|.
+ */
+static ngtcp2_conn *conn_server_new(const ngtcp2_mem *mem, uint64_t *pns) {
+  ngtcp2_callbacks cb;
+  ngtcp2_settings settings;
+  ngtcp2_transport_params params;
+  ngtcp2_cid dcid, scid;
+  ngtcp2_path_storage ps;
+  ngtcp2_conn *conn;
+  uint64_t t;
+
+  conn_callbacks_init(&cb);
+
+  ngtcp2_settings_default(&settings);
+  settings.initial_ts = 0;
+  settings.no_pmtud = 1;
+  /* Count the memory usage for ngtcp2_conn_get_mem_stat. */
+  settings.mem_budget = UINT64_MAX;
+
+  conn_transport_params_init(&params);
+
+  conn_rand(dcid.data, NGTCP2_MIN_INITIAL_DCIDLEN, NULL);
+  dcid.datalen = NGTCP2_MIN_INITIAL_DCIDLEN;
+  conn_rand(scid.data, NGTCP2_MIN_INITIAL_DCIDLEN, NULL);
+  scid.datalen = NGTCP2_MIN_INITIAL_DCIDLEN;
+  conn_rand(params.original_dcid.data, NGTCP2_MIN_INITIAL_DCIDLEN, NULL);
+  params.original_dcid.datalen = NGTCP2_MIN_INITIAL_DCIDLEN;
+  params.stateless_reset_token_present = 1;
+  conn_rand(params.stateless_reset_token, NGTCP2_STATELESS_RESET_TOKENLEN,
+            NULL);
+
+  conn_path_init(&ps);
+
+  t = timestamp_ns();
+  check(ngtcp2_conn_server_new(&conn, &dcid, &scid, &ps.path,
+                               NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
+                               mem, NULL),
+        "ngtcp2_conn_server_new");
+  *pns += timestamp_ns() - t;
+
+  conn_complete_handshake(conn, &params);
+
+  return conn;
+}
+
+/*
+ * bench_conn_idle creates |n| client connections, and sends a short
+ * request on a bidirectional stream from each of them, which leaves
+ * a connection idle waiting for the response.  The memory held by a
+ * connection at that point, including ngtcp2_conn object itself, is
+ * reported in bench_bytes.
+ */
+static uint64_t bench_conn_idle(size_t n, uint64_t *pops) {
+  ngtcp2_conn **conns = xmalloc(sizeof(ngtcp2_conn *) * n);
+  uint8_t req[256];
+  uint8_t buf[BENCH_PKTLEN];
+  ngtcp2_vec datav;
+  ngtcp2_ssize nwrite, ndatalen;
+  ngtcp2_mem_stat mem_stat;
+  int64_t stream_id;
+  uint64_t t, bytes = 0;
+  size_t i;
+
+  memset(req, 'r', sizeof(req));
+  datav.base = req;
+  datav.len = sizeof(req);
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    conns[i] = conn_client_new(NULL);
+
+    check(ngtcp2_conn_open_bidi_stream(conns[i], &stream_id, NULL),
+          "ngtcp2_conn_open_bidi_stream");
+
+    nwrite = ngtcp2_conn_writev_stream(
+        conns[i], NULL, NULL, buf, sizeof(buf), &ndatalen,
+        NGTCP2_WRITE_STREAM_FLAG_FIN, stream_id, &datav, 1, 0);
+    if (nwrite < 0) {
+      check((int)nwrite, "ngtcp2_conn_writev_stream");
+    }
+  }
+  t = timestamp_ns() - t;
+
+  for (i = 0; i < n; ++i) {
+    ngtcp2_conn_get_mem_stat(conns[i], &mem_stat);
+    bytes += sizeof(ngtcp2_conn) + mem_stat.total;
+
+    ngtcp2_conn_del(conns[i]);
+  }
+
+  free(conns);
+
+  bench_bytes = bytes / n;
+  *pops = n;
+
+  return t;
+}
+
+/* BENCH_CONN_CHURN_WINDOW is the number of connections which
+   conn_churn keeps alive at the same time. */
+#define BENCH_CONN_CHURN_WINDOW 1000
+
+/*
+ * conn_churn creates |n| client connections which allocate memory
+ * from |mem|, and sends a short request from each of them.  Each new
+ * connection replaces a randomly chosen one among the last
+ * BENCH_CONN_CHURN_WINDOW connections, which is deleted.
+ */
+static uint64_t conn_churn(size_t n, const ngtcp2_mem *mem, uint64_t *pops) {
+  ngtcp2_conn *conns[BENCH_CONN_CHURN_WINDOW] = {0};
+  uint8_t req[256];
+  uint8_t buf[BENCH_PKTLEN];
+  ngtcp2_vec datav;
+  ngtcp2_ssize nwrite, ndatalen;
+  int64_t stream_id;
+  uint64_t t;
+  size_t i, slot;
+
+  memset(req, 'r', sizeof(req));
+  datav.base = req;
+  datav.len = sizeof(req);
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    slot = i < BENCH_CONN_CHURN_WINDOW
+               ? i
+               : (size_t)(bench_rand() % BENCH_CONN_CHURN_WINDOW);
+
+    ngtcp2_conn_del(conns[slot]);
+
+    conns[slot] = conn_client_new(mem);
+
+    check(ngtcp2_conn_open_bidi_stream(conns[slot], &stream_id, NULL),
+          "ngtcp2_conn_open_bidi_stream");
+
+    nwrite = ngtcp2_conn_writev_stream(
+        conns[slot], NULL, NULL, buf, sizeof(buf), &ndatalen,
+        NGTCP2_WRITE_STREAM_FLAG_FIN, stream_id, &datav, 1, 0);
+    if (nwrite < 0) {
+      check((int)nwrite, "ngtcp2_conn_writev_stream");
+    }
+  }
+
+  for (i = 0; i < BENCH_CONN_CHURN_WINDOW; ++i) {
+    ngtcp2_conn_del(conns[i]);
+  }
+  t = timestamp_ns() - t;
+
+  *pops = n;
+
+  return t;
+}
+
+/*
+ * bench_conn_churn runs conn_churn with the default memory
+ * allocator.
+ */
+static uint64_t bench_conn_churn(size_t n, uint64_t *pops) {
+  return conn_churn(n, NULL, pops);
+}
+
+/*
+ * bench_conn_churn_arena runs conn_churn with ngtcp2_thread_arena.
+ */
+static uint64_t bench_conn_churn_arena(size_t n, uint64_t *pops) {
+  ngtcp2_thread_arena *arena;
+  uint64_t t;
+
+  check(ngtcp2_thread_arena_new(&arena, NULL), "ngtcp2_thread_arena_new");
+
+  t = conn_churn(n, ngtcp2_thread_arena_get_mem(arena), pops);
+
+  ngtcp2_thread_arena_del(arena);
+
+  return t;
+}
+
+/*
+ * bench_server_conn_idle creates |n| server connections which have
+ * completed the handshake and have nothing to do.  The memory held
+ * by a connection, including ngtcp2_conn object itself, is reported
+ * in bench_bytes, and the growth of the resident set size per
+ * connection is reported as well.
+ */
+static uint64_t bench_server_conn_idle(size_t n, uint64_t *pops) {
+  ngtcp2_conn **conns = xmalloc(sizeof(ngtcp2_conn *) * n);
+  ngtcp2_mem_stat mem_stat;
+  uint64_t t, new_ns = 0, bytes = 0, rss;
+  size_t i;
+
+  rss = rss_bytes();
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    conns[i] = conn_server_new(NULL, &new_ns);
+  }
+  t = timestamp_ns() - t;
+
+  rss = rss_growth(rss);
+
+  for (i = 0; i < n; ++i) {
+    ngtcp2_conn_get_mem_stat(conns[i], &mem_stat);
+    bytes += sizeof(ngtcp2_conn) + mem_stat.total;
+
+    ngtcp2_conn_del(conns[i]);
+  }
+
+  free(conns);
+
+  bench_bytes = bytes / n;
+  bench_conn_stat.rss_bytes = rss / n;
+  *pops = n;
+
+  return t;
+}
+
+/*
+ * bench_server_conn_scale creates |n| server connections which have
+ * completed the handshake, and then deletes all of them.  It reports
+ * the number of allocations to create a connection, the time spent
+ * in ngtcp2_conn_server_new and ngtcp2_conn_del, and the growth of
+ * the resident set size per connection.  Use --n to scale it to 1M
+ * connections.
+ */
+static uint64_t bench_server_conn_scale(size_t n, uint64_t *pops) {
+  ngtcp2_conn **conns = xmalloc(sizeof(ngtcp2_conn *) * n);
+  uint64_t t, new_ns = 0, del_ns, rss;
+  size_t i;
+
+  bench_nalloc = 0;
+  rss = rss_bytes();
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    conns[i] = conn_server_new(&bench_counting_mem, &new_ns);
+  }
+
+  rss = rss_growth(rss);
+
+  del_ns = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    ngtcp2_conn_del(conns[i]);
+  }
+  del_ns = timestamp_ns() - del_ns;
+  t = timestamp_ns() - t;
+
+  free(conns);
+
+  bench_conn_stat.allocs = bench_nalloc / n;
+  bench_conn_stat.rss_bytes = rss / n;
+  bench_conn_stat.new_ns = new_ns / n;
+  bench_conn_stat.del_ns = del_ns / n;
+  *pops = n;
+
+  return t;
+}
+
+/*
+ * bench_conn_crypto_flight submits a TLS flight of about 3KiB in 4
+ * messages to a connection, and writes packets until all of it is
+ * sent.  It models a server which sends its handshake flight.  Only
+ * the submission and the packet writes are timed, and the number of
+ * allocations made by them is reported.
+ */
+static uint64_t bench_conn_crypto_flight(size_t n, uint64_t *pops) {
+  static const size_t msglens[] = {90, 2500, 264, 36};
+  uint8_t msg[2500];
+  uint8_t buf[BENCH_PKTLEN];
+  ngtcp2_conn *conn;
+  ngtcp2_ssize nwrite;
+  uint64_t t = 0, nalloc = 0, ts;
+  size_t i, j;
+
+  memset(msg, 'c', sizeof(msg));
+
+  for (i = 0; i < n; ++i) {
+    conn = conn_client_new(&bench_counting_mem);
+
+    bench_nalloc = 0;
+    ts = timestamp_ns();
+
+    for (j = 0; j < sizeof(msglens) / sizeof(msglens[0]); ++j) {
+      check(ngtcp2_conn_submit_crypto_data(
+                conn, NGTCP2_CRYPTO_LEVEL_APPLICATION, msg, msglens[j]),
+            "ngtcp2_conn_submit_crypto_data");
+    }
+
+    for (;;) {
+      nwrite = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 0);
+      if (nwrite < 0) {
+        check((int)nwrite, "ngtcp2_conn_write_pkt");
+      }
+
+      if (nwrite == 0) {
+        break;
+      }
+    }
+
+    t += timestamp_ns() - ts;
+    nalloc += bench_nalloc;
+
+    ngtcp2_conn_del(conn);
+  }
+
+  bench_conn_stat.allocs = nalloc / n;
+  *pops = n;
+
+  return t;
+}
+
+/*
+ * conn_pair_new creates a client and a server ngtcp2_conn which have
+ * already completed the handshake with each other in the same way as
+ * the unit tests do, so that the packets written by one of them can
+ * be read by the other.  They allocate memory from |mem|.
+ */
+static void conn_pair_new(ngtcp2_conn **pclient, ngtcp2_conn **pserver,
+                          const ngtcp2_mem *mem) {
+  ngtcp2_callbacks cb;
+  ngtcp2_settings settings;
+  ngtcp2_transport_params params;
+  ngtcp2_cid client_scid, server_scid;
+  ngtcp2_path_storage ps;
+
+  conn_callbacks_init(&cb);
+
+  ngtcp2_settings_default(&settings);
+  settings.initial_ts = 0;
+  settings.no_pmtud = 1;
+
+  conn_transport_params_init(&params);
+  params.initial_max_stream_data_bidi_remote = 256 * 1024;
+
+  conn_rand(client_scid.data, NGTCP2_MIN_INITIAL_DCIDLEN, NULL);
+  client_scid.datalen = NGTCP2_MIN_INITIAL_DCIDLEN;
+  conn_rand(server_scid.data, NGTCP2_MIN_INITIAL_DCIDLEN, NULL);
+  server_scid.datalen = NGTCP2_MIN_INITIAL_DCIDLEN;
+
+  conn_path_init(&ps);
+
+  check(ngtcp2_conn_client_new(pclient, &server_scid, &client_scid, &ps.path,
+                               NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
+                               mem, NULL),
+        "ngtcp2_conn_client_new");
+
+  conn_complete_handshake(*pclient, &params);
+
+  params.original_dcid = server_scid;
+  params.stateless_reset_token_present = 1;
+  conn_rand(params.stateless_reset_token, NGTCP2_STATELESS_RESET_TOKENLEN,
+            NULL);
+
+  check(ngtcp2_conn_server_new(pserver, &client_scid, &server_scid, &ps.path,
+                               NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
+                               mem, NULL),
+        "ngtcp2_conn_server_new");
+
+  conn_complete_handshake(*pserver, &params);
+}
+
+/* BENCH_CONN_STEADY_STATE_WARMUP is the number of round trips which
+   bench_conn_steady_state makes before it starts measuring. */
+#define BENCH_CONN_STEADY_STATE_WARMUP 1000
+
+/*
+ * bench_conn_steady_state makes |n| round trips in which a client
+ * sends a packet of stream data, and a server reads it and writes a
+ * packet back.  Every 10th packet from the client is dropped, so
+ * that the server buffers out of order data and the client
+ * retransmits the lost data.  The number of allocations made after
+ * the warm up is reported, which should be close to 0.
+ */
+static uint64_t bench_conn_steady_state(size_t n, uint64_t *pops) {
+  ngtcp2_conn *client, *server;
+  uint8_t data[1000];
+  uint8_t buf[BENCH_PKTLEN];
+  ngtcp2_vec datav;
+  ngtcp2_ssize nwrite, ndatalen;
+  ngtcp2_path_storage ps;
+  int64_t stream_id;
+  uint64_t t = 0;
+  ngtcp2_tstamp ts = 0;
+  size_t i;
+
+  memset(data, 'd', sizeof(data));
+  datav.base = data;
+  datav.len = sizeof(data);
+
+  conn_path_init(&ps);
+  conn_pair_new(&client, &server, &bench_counting_mem);
+
+  check(ngtcp2_conn_open_bidi_stream(client, &stream_id, NULL),
+        "ngtcp2_conn_open_bidi_stream");
+
+  for (i = 0; i < BENCH_CONN_STEADY_STATE_WARMUP + n; ++i) {
+    if (i == BENCH_CONN_STEADY_STATE_WARMUP) {
+      bench_nalloc = 0;
+      t = timestamp_ns();
+    }
+
+    ts += NGTCP2_MILLISECONDS / 10;
+
+    nwrite =
+        ngtcp2_conn_writev_stream(client, NULL, NULL, buf, sizeof(buf),
+                                  &ndatalen, 0, stream_id, &datav, 1, ts);
+    if (nwrite < 0) {
+      check((int)nwrite, "ngtcp2_conn_writev_stream");
+    }
+
+    if (nwrite > 0 && i % 10 != 9) {
+      check(ngtcp2_conn_read_pkt(server, &ps.path, NULL, buf, (size_t)nwrite,
+                                 ts),
+            "ngtcp2_conn_read_pkt");
+    }
+
+    if (ndatalen > 0) {
+      check(ngtcp2_conn_extend_max_stream_offset(server, stream_id,
+                                                 (uint64_t)ndatalen),
+            "ngtcp2_conn_extend_max_stream_offset");
+      ngtcp2_conn_extend_max_offset(server, (uint64_t)ndatalen);
+    }
+
+    nwrite = ngtcp2_conn_write_pkt(server, NULL, NULL, buf, sizeof(buf), ts);
+    if (nwrite < 0) {
+      check((int)nwrite, "ngtcp2_conn_write_pkt");
+    }
+
+    if (nwrite > 0) {
+      check(ngtcp2_conn_read_pkt(client, &ps.path, NULL, buf, (size_t)nwrite,
+                                 ts),
+            "ngtcp2_conn_read_pkt");
+    }
+  }
+  t = timestamp_ns() - t;
+
+  bench_conn_stat.total_allocs = bench_nalloc;
+
+  ngtcp2_conn_del(client);
+  ngtcp2_conn_del(server);
+
+  *pops = n;
+
+  return t;
+}
+
+/*
+ * BENCH_FRAME_ENTRY expands to the entries of the benchmarks defined
+ * by BENCH_FRAME(NAME, ...).
+ */
+#define BENCH_FRAME_ENTRY(NAME)                                                \
+  {"frame_encode_" #NAME, 1000000, bench_frame_encode_##NAME},                 \
+      {"frame_decode_" #NAME, 1000000, bench_frame_decode_##NAME}
+
+static const bench benches[] = {
+    {"ksl_insert", 10000, bench_ksl_insert},
+    {"ksl_lookup", 10000, bench_ksl_lookup},
+    {"ksl_iterate", 10000, bench_ksl_iterate},
+    {"ksl_remove", 10000, bench_ksl_remove},
+    {"map_insert", 10000, bench_map_insert},
+    {"map_lookup", 10000, bench_map_lookup},
+    {"map_remove", 10000, bench_map_remove},
+    {"pq_push_pop", 10000, bench_pq_push_pop},
+    {"pq4_push_pop", 10000, bench_pq4_push_pop},
+    {"pq_round_robin", 10000, bench_pq_round_robin},
+    {"pq4_round_robin", 10000, bench_pq4_round_robin},
+    {"cycleq_round_robin", 10000, bench_cycleq_round_robin},
+    {"rob_reorder", 10000, bench_rob_reorder},
+    {"gaptr_reorder", 10000, bench_gaptr_reorder},
+    {"acktr_ack_loss", 10000, bench_acktr_ack_loss},
+    {"rtb_add", 10000, bench_rtb_add},
+    {"rtb_recv_ack", 10000, bench_rtb_recv_ack},
+    {"window_filter_update", 1000000, bench_window_filter_update},
+    {"cc_ack_reno", 1000000, bench_cc_ack_reno},
+    {"cc_ack_cubic", 1000000, bench_cc_ack_cubic},
+    {"cc_ack_bbr", 1000000, bench_cc_ack_bbr},
+    {"cc_ack_bbr2", 1000000, bench_cc_ack_bbr2},
+    {"decode_ack", 100000, bench_decode_ack},
+    {"decode_stream", 1000000, bench_decode_stream},
+    BENCH_FRAME_ENTRY(padding),
+    BENCH_FRAME_ENTRY(ping),
+    BENCH_FRAME_ENTRY(ack),
+    BENCH_FRAME_ENTRY(ack_ecn),
+    BENCH_FRAME_ENTRY(reset_stream),
+    BENCH_FRAME_ENTRY(stop_sending),
+    BENCH_FRAME_ENTRY(crypto),
+    BENCH_FRAME_ENTRY(new_token),
+    BENCH_FRAME_ENTRY(stream),
+    BENCH_FRAME_ENTRY(max_data),
+    BENCH_FRAME_ENTRY(max_stream_data),
+    BENCH_FRAME_ENTRY(max_streams),
+    BENCH_FRAME_ENTRY(data_blocked),
+    BENCH_FRAME_ENTRY(stream_data_blocked),
+    BENCH_FRAME_ENTRY(streams_blocked),
+    BENCH_FRAME_ENTRY(new_connection_id),
+    BENCH_FRAME_ENTRY(retire_connection_id),
+    BENCH_FRAME_ENTRY(path_challenge),
+    BENCH_FRAME_ENTRY(path_response),
+    BENCH_FRAME_ENTRY(connection_close),
+    BENCH_FRAME_ENTRY(handshake_done),
+    BENCH_FRAME_ENTRY(datagram),
+    BENCH_FRAME_ENTRY(ack_frequency),
+    BENCH_FRAME_ENTRY(immediate_ack),
+    BENCH_FRAME_ENTRY(repair),
+    {"conn_idle", 1000, bench_conn_idle},
+    {"conn_churn", 10000, bench_conn_churn},
+    {"conn_crypto_flight", 10000, bench_conn_crypto_flight},
+    {"conn_churn_arena", 10000, bench_conn_churn_arena},
+    {"server_conn_idle", 1000, bench_server_conn_idle},
+    {"server_conn_scale", 100000, bench_server_conn_scale},
+    {"conn_steady_state", 10000, bench_conn_steady_state},
+};
+
+static void print_usage(void) {
+  printf("Usage: bench [OPTIONS] [PATTERN...]\n"
+         "Run the benchmarks whose name contains one of PATTERNs, or all\n"
+         "benchmarks if no PATTERN is given.  The result is written to\n"
+         "stdout in JSON.\n"
+         "Options:\n"
+         "  -r, --rounds=<N>  The number of times each benchmark is run.\n"
+         "                    Default: 10\n"
+         "  -s, --seed=<N>    Seed for the random number generator.\n"
+         "                    Default: 0\n"
+         "  -n, --n=<N>       Override the number of elements of each\n"
+         "                    benchmark, e.g., 1000000 to run\n"
+         "                    server_conn_scale with 1M connections.\n"
+         "  -l, --list        List benchmarks and exit.\n"
+         "  -h, --help        Display this help and exit.\n");
+}
+
+static int match(const char *name, char **patterns, size_t npatterns) {
+  size_t i;
+
+  if (npatterns == 0) {
+    return 1;
+  }
+
+  for (i = 0; i < npatterns; ++i) {
+    if (strstr(name, patterns[i])) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  size_t rounds = 10;
+  uint64_t seed = 0;
+  size_t n_override = 0;
+  uint64_t ns, ops, best, sum;
+  size_t i, r, n;
+  int first = 1;
+
+  for (;;) {
+    static struct option long_opts[] = {
+        {"rounds", required_argument, NULL, 'r'},
+        {"seed", required_argument, NULL, 's'},
+        {"n", required_argument, NULL, 'n'},
+        {"list", no_argument, NULL, 'l'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int optidx = 0;
+    int c = getopt_long(argc, argv, "r:s:n:lh", long_opts, &optidx);
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case 'r':
+      rounds = (size_t)strtoul(optarg, NULL, 10);
+      if (rounds == 0) {
+        fprintf(stderr, "bench: rounds must be positive\n");
+        return EXIT_FAILURE;
+      }
+      break;
+    case 's':
+      seed = strtoull(optarg, NULL, 10);
+      break;
+    case 'n':
+      n_override = (size_t)strtoul(optarg, NULL, 10);
+      if (n_override == 0) {
+        fprintf(stderr, "bench: n must be positive\n");
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'l':
+      for (i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i) {
+        printf("%s\n", benches[i].name);
+      }
+      return EXIT_SUCCESS;
+    case 'h':
+      print_usage();
+      return EXIT_SUCCESS;
+    default:
+      print_usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  printf("{\n"
+         "  \"version\": \"%s\",\n"
+         "  \"rounds\": %zu,\n"
+         "  \"seed\": %" PRIu64 ",\n"
+         "  \"benchmarks\": [",
+         ngtcp2_version(0)->version_str, rounds, seed);
+
+  for (i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i) {
+    if (!match(benches[i].name, argv + optind, (size_t)(argc - optind))) {
+      continue;
+    }
+
+    n = n_override ? n_override : benches[i].n;
+    bench_rand_state = seed;
+    bench_bytes = 0;
+    memset(&best_conn_stat, 0, sizeof(best_conn_stat));
+    best = UINT64_MAX;
+    sum = 0;
+    ops = 0;
+
+    for (r = 0; r < rounds; ++r) {
+      memset(&bench_conn_stat, 0, sizeof(bench_conn_stat));
+      ns = benches[i].func(n, &ops);
+      if (ns < best) {
+        best = ns;
+        best_conn_stat = bench_conn_stat;
+      }
+      sum += ns;
+    }
+
+    printf("%s\n"
+           "    {\n"
+           "      \"name\": \"%s\",\n"
+           "      \"n\": %zu,\n"
+           "      \"ops\": %" PRIu64 ",\n"
+           "      \"best_ns\": %" PRIu64 ",\n"
+           "      \"mean_ns\": %" PRIu64 ",\n"
+           "      \"best_ns_per_op\": %.2f",
+           first ? "" : ",", benches[i].name, n, ops, best,
+           sum / rounds, ops ? (double)best / (double)ops : 0.);
+
+    if (bench_bytes) {
+      printf(",\n"
+             "      \"bytes_per_op\": %" PRIu64,
+             bench_bytes);
+    }
+
+    if (best_conn_stat.allocs) {
+      printf(",\n"
+             "      \"allocs_per_op\": %" PRIu64,
+             best_conn_stat.allocs);
+    }
+
+    if (best_conn_stat.total_allocs) {
+      printf(",\n"
+             "      \"allocs\": %" PRIu64,
+             best_conn_stat.total_allocs);
+    }
+
+    if (best_conn_stat.rss_bytes) {
+      printf(",\n"
+             "      \"rss_bytes_per_op\": %" PRIu64,
+             best_conn_stat.rss_bytes);
+    }
+
+    if (best_conn_stat.new_ns) {
+      printf(",\n"
+             "      \"conn_new_ns_per_op\": %" PRIu64,
+             best_conn_stat.new_ns);
+    }
+
+    if (best_conn_stat.del_ns) {
+      printf(",\n"
+             "      \"conn_del_ns_per_op\": %" PRIu64,
+             best_conn_stat.del_ns);
+    }
+
+    printf("\n"
+           "    }");
+
+    first = 0;
+  }
+
+  printf("\n  ]\n}\n");
+
+  return EXIT_SUCCESS;
+}
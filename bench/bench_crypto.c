@@ -0,0 +1,471 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * bench_crypto measures the packet protection of the crypto backend
+ * which it is linked to.  It uses AES-128-GCM and AES-128 header
+ * protection, that is, the cipher suite of Initial packets, so that
+ * the results are comparable between backends.  The result is
+ * written to stdout in JSON in the same format as bench.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <ngtcp2/ngtcp2_crypto.h>
+
+#ifdef NGTCP2_BENCH_CRYPTO_OPENSSL
+#  include <ngtcp2/ngtcp2_crypto_openssl.h>
+#endif /* NGTCP2_BENCH_CRYPTO_OPENSSL */
+
+#include "shared.h"
+
+#ifndef NGTCP2_BENCH_CRYPTO_BACKEND
+#  define NGTCP2_BENCH_CRYPTO_BACKEND "unknown"
+#endif /* !NGTCP2_BENCH_CRYPTO_BACKEND */
+
+#define BENCH_PKTLEN 1200
+#define BENCH_AADLEN 21
+#define BENCH_NONCELEN 12
+#define BENCH_BATCHLEN 64
+
+typedef uint64_t (*bench_func)(size_t n, uint64_t *pops);
+
+typedef struct bench {
+  const char *name;
+  size_t n;
+  bench_func func;
+} bench;
+
+typedef struct bench_crypto {
+  ngtcp2_crypto_ctx ctx;
+  ngtcp2_crypto_aead_ctx aead_ctx;
+  ngtcp2_crypto_aead_ctx decrypt_aead_ctx;
+  ngtcp2_crypto_cipher_ctx hp_ctx;
+} bench_crypto;
+
+static uint64_t timestamp_ns(void) {
+  struct timespec tp;
+
+  clock_gettime(CLOCK_MONOTONIC, &tp);
+
+  return (uint64_t)tp.tv_sec * 1000000000 + (uint64_t)tp.tv_nsec;
+}
+
+static void check(int rv, const char *what) {
+  if (rv != 0) {
+    fprintf(stderr, "bench_crypto: %s failed: %d\n", what, rv);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void bench_crypto_init(bench_crypto *bc) {
+  static const uint8_t key[16] = {0x1f, 0x36, 0x96, 0x13, 0xdd, 0x76,
+                                  0xd5, 0x46, 0x77, 0x30, 0xef, 0xcb,
+                                  0xe3, 0xb1, 0xa2, 0x2d};
+  static const uint8_t hp_key[16] = {0x9f, 0x50, 0x44, 0x9e, 0x04, 0xa0,
+                                     0xe8, 0x10, 0x28, 0x3a, 0x1e, 0x99,
+                                     0x33, 0xad, 0xed, 0xd2};
+
+  ngtcp2_crypto_ctx_initial(&bc->ctx);
+
+  check(ngtcp2_crypto_aead_ctx_encrypt_init(&bc->aead_ctx, &bc->ctx.aead, key,
+                                            BENCH_NONCELEN),
+        "ngtcp2_crypto_aead_ctx_encrypt_init");
+  check(ngtcp2_crypto_aead_ctx_decrypt_init(&bc->decrypt_aead_ctx,
+                                            &bc->ctx.aead, key,
+                                            BENCH_NONCELEN),
+        "ngtcp2_crypto_aead_ctx_decrypt_init");
+  check(ngtcp2_crypto_cipher_ctx_encrypt_init(&bc->hp_ctx, &bc->ctx.hp,
+                                              hp_key),
+        "ngtcp2_crypto_cipher_ctx_encrypt_init");
+}
+
+static void bench_crypto_free(bench_crypto *bc) {
+  ngtcp2_crypto_aead_ctx_free(&bc->aead_ctx);
+  ngtcp2_crypto_aead_ctx_free(&bc->decrypt_aead_ctx);
+  ngtcp2_crypto_cipher_ctx_free(&bc->hp_ctx);
+}
+
+static void make_nonce(uint8_t *nonce, size_t i) {
+  memset(nonce, 0, BENCH_NONCELEN);
+  memcpy(nonce + BENCH_NONCELEN - sizeof(i), &i, sizeof(i));
+}
+
+/*
+ * bench_encrypt encrypts |n| packets of BENCH_PKTLEN bytes in place.
+ */
+static uint64_t bench_encrypt(size_t n, uint64_t *pops) {
+  bench_crypto bc;
+  static uint8_t pkt[BENCH_AADLEN + BENCH_PKTLEN + 16];
+  uint8_t nonce[BENCH_NONCELEN];
+  uint64_t t;
+  size_t i;
+
+  bench_crypto_init(&bc);
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    make_nonce(nonce, i);
+    check(ngtcp2_crypto_encrypt(pkt + BENCH_AADLEN, &bc.ctx.aead, &bc.aead_ctx,
+                                pkt + BENCH_AADLEN, BENCH_PKTLEN, nonce,
+                                BENCH_NONCELEN, pkt, BENCH_AADLEN),
+          "ngtcp2_crypto_encrypt");
+  }
+  t = timestamp_ns() - t;
+
+  bench_crypto_free(&bc);
+
+  *pops = n;
+
+  return t;
+}
+
+/*
+ * bench_encrypt_vec encrypts |n| packets of BENCH_PKTLEN bytes whose
+ * STREAM data is taken from a separate buffer.
+ */
+static uint64_t bench_encrypt_vec(size_t n, uint64_t *pops) {
+  bench_crypto bc;
+  static uint8_t pkt[BENCH_AADLEN + BENCH_PKTLEN + 16];
+  static uint8_t data[BENCH_PKTLEN];
+  uint8_t nonce[BENCH_NONCELEN];
+  ngtcp2_vec vec[2];
+  uint64_t t;
+  size_t i;
+
+  bench_crypto_init(&bc);
+
+  /* STREAM frame header and the data */
+  vec[0].base = pkt + BENCH_AADLEN;
+  vec[0].len = 16;
+  vec[1].base = data;
+  vec[1].len = BENCH_PKTLEN - vec[0].len;
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    make_nonce(nonce, i);
+    check(ngtcp2_crypto_encrypt_vec(pkt + BENCH_AADLEN, &bc.ctx.aead,
+                                    &bc.aead_ctx, vec, 2, nonce,
+                                    BENCH_NONCELEN, pkt, BENCH_AADLEN),
+          "ngtcp2_crypto_encrypt_vec");
+  }
+  t = timestamp_ns() - t;
+
+  bench_crypto_free(&bc);
+
+  *pops = n;
+
+  return t;
+}
+
+/*
+ * bench_decrypt decrypts |n| packets of BENCH_PKTLEN bytes.
+ */
+static uint64_t bench_decrypt(size_t n, uint64_t *pops) {
+  bench_crypto bc;
+  static uint8_t pkt[BENCH_AADLEN + BENCH_PKTLEN + 16];
+  static uint8_t out[BENCH_PKTLEN];
+  uint8_t nonce[BENCH_NONCELEN];
+  uint64_t t;
+  size_t i;
+
+  bench_crypto_init(&bc);
+
+  make_nonce(nonce, 0);
+  check(ngtcp2_crypto_encrypt(pkt + BENCH_AADLEN, &bc.ctx.aead, &bc.aead_ctx,
+                              pkt + BENCH_AADLEN, BENCH_PKTLEN, nonce,
+                              BENCH_NONCELEN, pkt, BENCH_AADLEN),
+        "ngtcp2_crypto_encrypt");
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    check(ngtcp2_crypto_decrypt(out, &bc.ctx.aead, &bc.decrypt_aead_ctx,
+                                pkt + BENCH_AADLEN, BENCH_PKTLEN + 16, nonce,
+                                BENCH_NONCELEN, pkt, BENCH_AADLEN),
+          "ngtcp2_crypto_decrypt");
+  }
+  t = timestamp_ns() - t;
+
+  bench_crypto_free(&bc);
+
+  *pops = n;
+
+  return t;
+}
+
+/*
+ * bench_hp_mask produces |n| header protection masks one at a time.
+ */
+static uint64_t bench_hp_mask(size_t n, uint64_t *pops) {
+  bench_crypto bc;
+  uint8_t sample[NGTCP2_HP_SAMPLELEN] = {0};
+  uint8_t mask[NGTCP2_HP_SAMPLELEN];
+  uint64_t t;
+  size_t i;
+
+  bench_crypto_init(&bc);
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    sample[0] = (uint8_t)i;
+    check(ngtcp2_crypto_hp_mask(mask, &bc.ctx.hp, &bc.hp_ctx, sample),
+          "ngtcp2_crypto_hp_mask");
+  }
+  t = timestamp_ns() - t;
+
+  bench_crypto_free(&bc);
+
+  *pops = n;
+
+  return t;
+}
+
+/*
+ * bench_hp_mask_batch produces |n| header protection masks in
+ * batches of BENCH_BATCHLEN.
+ */
+static uint64_t bench_hp_mask_batch(size_t n, uint64_t *pops) {
+  bench_crypto bc;
+  static uint8_t samples[BENCH_BATCHLEN][NGTCP2_HP_SAMPLELEN];
+  static uint8_t masks[BENCH_BATCHLEN * NGTCP2_HP_SAMPLELEN];
+  const uint8_t *psamples[BENCH_BATCHLEN];
+  uint64_t t;
+  size_t i;
+
+  bench_crypto_init(&bc);
+
+  for (i = 0; i < BENCH_BATCHLEN; ++i) {
+    samples[i][0] = (uint8_t)i;
+    psamples[i] = samples[i];
+  }
+
+  n = (n + BENCH_BATCHLEN - 1) / BENCH_BATCHLEN * BENCH_BATCHLEN;
+
+  t = timestamp_ns();
+  for (i = 0; i < n; i += BENCH_BATCHLEN) {
+    check(ngtcp2_crypto_hp_mask_batch_cb(masks, &bc.ctx.hp, &bc.hp_ctx,
+                                         psamples, BENCH_BATCHLEN),
+          "ngtcp2_crypto_hp_mask_batch_cb");
+  }
+  t = timestamp_ns() - t;
+
+  bench_crypto_free(&bc);
+
+  *pops = n;
+
+  return t;
+}
+
+/*
+ * bench_initial_key derives and sets up |n| pairs of Initial keys the
+ * way a server does for each new connection.
+ */
+static uint64_t bench_initial_key(size_t n, uint64_t *pops) {
+  ngtcp2_crypto_ctx ctx;
+  ngtcp2_crypto_aead_ctx aead_ctx[2];
+  ngtcp2_crypto_cipher_ctx hp_ctx[2];
+  uint8_t secret[2][NGTCP2_CRYPTO_INITIAL_SECRETLEN];
+  uint8_t key[2][NGTCP2_CRYPTO_INITIAL_KEYLEN];
+  uint8_t iv[2][NGTCP2_CRYPTO_INITIAL_IVLEN];
+  uint8_t hp_key[2][NGTCP2_CRYPTO_INITIAL_KEYLEN];
+  ngtcp2_cid dcid;
+  uint64_t t;
+  size_t i, j;
+
+  ngtcp2_crypto_ctx_initial(&ctx);
+
+  dcid.datalen = NGTCP2_MIN_INITIAL_DCIDLEN;
+  memset(dcid.data, 0, dcid.datalen);
+
+  t = timestamp_ns();
+  for (i = 0; i < n; ++i) {
+    memcpy(dcid.data, &i, sizeof(i));
+
+    check(ngtcp2_crypto_derive_initial_secrets(NGTCP2_PROTO_VER_V1, secret[0],
+                                               secret[1], NULL, &dcid,
+                                               NGTCP2_CRYPTO_SIDE_SERVER),
+          "ngtcp2_crypto_derive_initial_secrets");
+
+    for (j = 0; j < 2; ++j) {
+      check(ngtcp2_crypto_derive_packet_protection_key(
+                key[j], iv[j], hp_key[j], NGTCP2_PROTO_VER_V1, &ctx.aead,
+                &ctx.md, secret[j], NGTCP2_CRYPTO_INITIAL_SECRETLEN),
+            "ngtcp2_crypto_derive_packet_protection_key");
+    }
+
+    check(ngtcp2_crypto_aead_ctx_decrypt_init(&aead_ctx[0], &ctx.aead, key[0],
+                                              NGTCP2_CRYPTO_INITIAL_IVLEN),
+          "ngtcp2_crypto_aead_ctx_decrypt_init");
+    check(ngtcp2_crypto_aead_ctx_encrypt_init(&aead_ctx[1], &ctx.aead, key[1],
+                                              NGTCP2_CRYPTO_INITIAL_IVLEN),
+          "ngtcp2_crypto_aead_ctx_encrypt_init");
+
+    for (j = 0; j < 2; ++j) {
+      check(ngtcp2_crypto_cipher_ctx_encrypt_init(&hp_ctx[j], &ctx.hp,
+                                                  hp_key[j]),
+            "ngtcp2_crypto_cipher_ctx_encrypt_init");
+    }
+
+    for (j = 0; j < 2; ++j) {
+      ngtcp2_crypto_aead_ctx_free(&aead_ctx[j]);
+      ngtcp2_crypto_cipher_ctx_free(&hp_ctx[j]);
+    }
+  }
+  t = timestamp_ns() - t;
+
+  *pops = n;
+
+  return t;
+}
+
+static const bench benches[] = {
+    {"encrypt", 100000, bench_encrypt},
+    {"encrypt_vec", 100000, bench_encrypt_vec},
+    {"decrypt", 100000, bench_decrypt},
+    {"hp_mask", 1000000, bench_hp_mask},
+    {"hp_mask_batch", 1000000, bench_hp_mask_batch},
+    {"initial_key", 10000, bench_initial_key},
+};
+
+static void print_usage(void) {
+  printf("Usage: bench_crypto [OPTIONS] [PATTERN...]\n"
+         "Run the benchmarks whose name contains one of PATTERNs, or all\n"
+         "benchmarks if no PATTERN is given.  The result is written to\n"
+         "stdout in JSON.\n"
+         "Options:\n"
+         "  -r, --rounds=<N>  The number of times each benchmark is run.\n"
+         "                    Default: 10\n"
+         "  -l, --list        List benchmarks and exit.\n"
+         "  -h, --help        Display this help and exit.\n");
+}
+
+static int match(const char *name, char **patterns, size_t npatterns) {
+  size_t i;
+
+  if (npatterns == 0) {
+    return 1;
+  }
+
+  for (i = 0; i < npatterns; ++i) {
+    if (strstr(name, patterns[i])) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  size_t rounds = 10;
+  uint64_t ns, ops, best, sum;
+  size_t i, r;
+  int first = 1;
+
+  for (;;) {
+    static struct option long_opts[] = {
+        {"rounds", required_argument, NULL, 'r'},
+        {"list", no_argument, NULL, 'l'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int optidx = 0;
+    int c = getopt_long(argc, argv, "r:lh", long_opts, &optidx);
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case 'r':
+      rounds = (size_t)strtoul(optarg, NULL, 10);
+      if (rounds == 0) {
+        fprintf(stderr, "bench_crypto: rounds must be positive\n");
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'l':
+      for (i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i) {
+        printf("%s\n", benches[i].name);
+      }
+      return EXIT_SUCCESS;
+    case 'h':
+      print_usage();
+      return EXIT_SUCCESS;
+    default:
+      print_usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+#ifdef NGTCP2_BENCH_CRYPTO_OPENSSL
+  check(ngtcp2_crypto_openssl_init(), "ngtcp2_crypto_openssl_init");
+#endif /* NGTCP2_BENCH_CRYPTO_OPENSSL */
+
+  printf("{\n"
+         "  \"version\": \"%s\",\n"
+         "  \"backend\": \"%s\",\n"
+         "  \"rounds\": %zu,\n"
+         "  \"benchmarks\": [",
+         ngtcp2_version(0)->version_str, NGTCP2_BENCH_CRYPTO_BACKEND, rounds);
+
+  for (i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i) {
+    if (!match(benches[i].name, argv + optind, (size_t)(argc - optind))) {
+      continue;
+    }
+
+    best = UINT64_MAX;
+    sum = 0;
+    ops = 0;
+
+    for (r = 0; r < rounds; ++r) {
+      ns = benches[i].func(benches[i].n, &ops);
+      if (ns < best) {
+        best = ns;
+      }
+      sum += ns;
+    }
+
+    printf("%s\n"
+           "    {\n"
+           "      \"name\": \"%s\",\n"
+           "      \"n\": %zu,\n"
+           "      \"ops\": %" PRIu64 ",\n"
+           "      \"best_ns\": %" PRIu64 ",\n"
+           "      \"mean_ns\": %" PRIu64 ",\n"
+           "      \"best_ns_per_op\": %.2f\n"
+           "    }",
+           first ? "" : ",", benches[i].name, benches[i].n, ops, best,
+           sum / rounds, ops ? (double)best / (double)ops : 0.);
+
+    first = 0;
+  }
+
+  printf("\n  ]\n}\n");
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,758 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * bench_handshake measures the rate of QUIC handshakes between a
+ * client and a server ngtcp2_conn which run in the same thread and
+ * exchange packets in memory.  It uses the OpenSSL backend with
+ * QUIC support for TLS.  The full 1-RTT handshake, the resumed
+ * handshake, and the handshake with 0-RTT data are measured.  The
+ * time spent in the Initial key derivation, TLS, encoding the local
+ * transport parameters, and the connection ID generation is also
+ * reported.  The peer's transport parameters are decoded from the
+ * callback of TLS stack, so that they are counted as TLS.  The
+ * result is written to stdout in JSON in the same format as bench.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <ngtcp2/ngtcp2_crypto.h>
+#include <ngtcp2/ngtcp2_crypto_openssl.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/rand.h>
+
+#include "shared.h"
+
+#define BENCH_MAX_PKTLEN 1500
+/* BENCH_SCIDLEN is the length of the server's Connection ID. */
+#define BENCH_SCIDLEN 18
+/* BENCH_MAX_ROUNDTRIPS is the maximum number of round trips that a
+   handshake takes before bench_handshake gives up. */
+#define BENCH_MAX_ROUNDTRIPS 16
+
+static const uint8_t alpn[] = "\x0ahq-interop";
+
+typedef enum bench_mode {
+  BENCH_MODE_FULL,
+  BENCH_MODE_RESUMED,
+  BENCH_MODE_0RTT,
+} bench_mode;
+
+typedef struct bench {
+  const char *name;
+  bench_mode mode;
+} bench;
+
+static const bench benches[] = {
+    {"handshake_full", BENCH_MODE_FULL},
+    {"handshake_resumed", BENCH_MODE_RESUMED},
+    {"handshake_0rtt", BENCH_MODE_0RTT},
+};
+
+/*
+ * bench_phases is the time in nanoseconds spent in each phase of
+ * handshakes.
+ */
+typedef struct bench_phases {
+  uint64_t initial;
+  uint64_t tls;
+  uint64_t transport_params;
+  uint64_t cid;
+} bench_phases;
+
+typedef struct bench_endpoint {
+  ngtcp2_crypto_conn_ref conn_ref;
+  ngtcp2_conn *conn;
+  SSL *ssl;
+  ngtcp2_path_storage ps;
+  /* stream_id is the stream to send 0-RTT data on, or -1. */
+  int64_t stream_id;
+} bench_endpoint;
+
+typedef struct bench_ctx {
+  SSL_CTX *client_ssl_ctx;
+  SSL_CTX *server_ssl_ctx;
+  /* session is the TLS session which the client resumes. */
+  SSL_SESSION *session;
+  /* early_params is the server's transport parameters remembered
+     for 0-RTT. */
+  ngtcp2_transport_params early_params;
+  ngtcp2_sockaddr_in6 client_addr;
+  ngtcp2_sockaddr_in6 server_addr;
+  uint8_t static_secret[32];
+  /* nearly_data_accepted is the number of handshakes in which 0-RTT
+     data was accepted. */
+  uint64_t nearly_data_accepted;
+} bench_ctx;
+
+static bench_phases phases;
+
+static uint64_t timestamp_ns(void) {
+  struct timespec tp;
+
+  clock_gettime(CLOCK_MONOTONIC, &tp);
+
+  return (uint64_t)tp.tv_sec * 1000000000 + (uint64_t)tp.tv_nsec;
+}
+
+static void check(int rv, const char *what) {
+  if (rv != 0) {
+    fprintf(stderr, "bench_handshake: %s failed: %d\n", what, rv);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static ngtcp2_conn *get_conn(ngtcp2_crypto_conn_ref *conn_ref) {
+  bench_endpoint *ep = conn_ref->user_data;
+
+  return ep->conn;
+}
+
+static void conn_rand(uint8_t *dest, size_t destlen,
+                      const ngtcp2_rand_ctx *rand_ctx) {
+  (void)rand_ctx;
+
+  if (RAND_bytes(dest, (int)destlen) != 1) {
+    check(-1, "RAND_bytes");
+  }
+}
+
+/*
+ * generate_cid generates a random connection ID of length |cidlen|
+ * and its stateless reset token.
+ */
+static int generate_cid(ngtcp2_cid *cid, uint8_t *token, size_t cidlen,
+                        const bench_ctx *bc) {
+  uint64_t t = timestamp_ns();
+
+  if (RAND_bytes(cid->data, (int)cidlen) != 1) {
+    return -1;
+  }
+
+  cid->datalen = cidlen;
+
+  if (ngtcp2_crypto_generate_stateless_reset_token(
+          token, bc->static_secret, sizeof(bc->static_secret), cid) != 0) {
+    return -1;
+  }
+
+  phases.cid += timestamp_ns() - t;
+
+  return 0;
+}
+
+static bench_ctx *bctx;
+
+static int conn_get_new_connection_id(ngtcp2_conn *conn, ngtcp2_cid *cid,
+                                      uint8_t *token, size_t cidlen,
+                                      void *user_data) {
+  (void)conn;
+  (void)user_data;
+
+  if (generate_cid(cid, token, cidlen, bctx) != 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+
+/*
+ * conn_client_initial does what ngtcp2_crypto_client_initial_cb
+ * does, measuring each step.
+ */
+static int conn_client_initial(ngtcp2_conn *conn, void *user_data) {
+  uint8_t buf[256];
+  ngtcp2_ssize nwrite;
+  uint64_t t;
+  int rv;
+  (void)user_data;
+
+  t = timestamp_ns();
+  rv = ngtcp2_crypto_derive_and_install_initial_key(
+      conn, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+      ngtcp2_conn_get_client_chosen_version(conn), ngtcp2_conn_get_dcid(conn));
+  phases.initial += timestamp_ns() - t;
+  if (rv != 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  t = timestamp_ns();
+  nwrite = ngtcp2_conn_encode_local_transport_params(conn, buf, sizeof(buf));
+  if (nwrite < 0 ||
+      ngtcp2_crypto_set_local_transport_params(
+          ngtcp2_conn_get_tls_native_handle(conn), buf, (size_t)nwrite) != 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+  phases.transport_params += timestamp_ns() - t;
+
+  t = timestamp_ns();
+  rv = ngtcp2_crypto_read_write_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_INITIAL,
+                                            NULL, 0);
+  phases.tls += timestamp_ns() - t;
+  if (rv != 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+
+static int conn_recv_client_initial(ngtcp2_conn *conn, const ngtcp2_cid *dcid,
+                                    void *user_data) {
+  uint64_t t = timestamp_ns();
+  int rv;
+
+  rv = ngtcp2_crypto_recv_client_initial_cb(conn, dcid, user_data);
+  phases.initial += timestamp_ns() - t;
+
+  return rv;
+}
+
+static int conn_recv_crypto_data(ngtcp2_conn *conn,
+                                 ngtcp2_crypto_level crypto_level,
+                                 uint64_t offset, const uint8_t *data,
+                                 size_t datalen, void *user_data) {
+  uint64_t t = timestamp_ns();
+  int rv;
+
+  rv = ngtcp2_crypto_recv_crypto_data_cb(conn, crypto_level, offset, data,
+                                         datalen, user_data);
+  phases.tls += timestamp_ns() - t;
+
+  return rv;
+}
+
+static int new_session_cb(SSL *ssl, SSL_SESSION *session) {
+  (void)ssl;
+
+  if (bctx->session) {
+    return 0;
+  }
+
+  bctx->session = session;
+
+  return 1;
+}
+
+static int alpn_select_cb(SSL *ssl, const unsigned char **out,
+                          unsigned char *outlen, const unsigned char *in,
+                          unsigned int inlen, void *arg) {
+  (void)ssl;
+  (void)arg;
+
+  if (SSL_select_next_proto((unsigned char **)out, outlen, alpn,
+                            sizeof(alpn) - 1, in,
+                            inlen) != OPENSSL_NPN_NEGOTIATED) {
+    return SSL_TLSEXT_ERR_ALERT_FATAL;
+  }
+
+  return SSL_TLSEXT_ERR_OK;
+}
+
+static void bench_ctx_init(bench_ctx *bc, const char *private_key_file,
+                           const char *cert_file) {
+  memset(bc, 0, sizeof(*bc));
+
+  bc->server_ssl_ctx = SSL_CTX_new(TLS_server_method());
+  if (!bc->server_ssl_ctx ||
+      ngtcp2_crypto_openssl_configure_server_context(bc->server_ssl_ctx) !=
+          0) {
+    check(-1, "server SSL_CTX initialization");
+  }
+
+  SSL_CTX_set_max_early_data(bc->server_ssl_ctx, UINT32_MAX);
+  SSL_CTX_set_options(bc->server_ssl_ctx, SSL_OP_NO_ANTI_REPLAY);
+  SSL_CTX_set_alpn_select_cb(bc->server_ssl_ctx, alpn_select_cb, NULL);
+
+  if (SSL_CTX_use_PrivateKey_file(bc->server_ssl_ctx, private_key_file,
+                                  SSL_FILETYPE_PEM) != 1 ||
+      SSL_CTX_use_certificate_chain_file(bc->server_ssl_ctx, cert_file) != 1 ||
+      SSL_CTX_check_private_key(bc->server_ssl_ctx) != 1) {
+    fprintf(stderr, "bench_handshake: could not load key and certificate: %s\n",
+            ERR_error_string(ERR_get_error(), NULL));
+    exit(EXIT_FAILURE);
+  }
+
+  bc->client_ssl_ctx = SSL_CTX_new(TLS_client_method());
+  if (!bc->client_ssl_ctx ||
+      ngtcp2_crypto_openssl_configure_client_context(bc->client_ssl_ctx) !=
+          0) {
+    check(-1, "client SSL_CTX initialization");
+  }
+
+  SSL_CTX_set_session_cache_mode(bc->client_ssl_ctx,
+                                 SSL_SESS_CACHE_CLIENT |
+                                     SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(bc->client_ssl_ctx, new_session_cb);
+
+  bc->client_addr.sin6_family = NGTCP2_AF_INET6;
+  bc->client_addr.sin6_port = htons(44300);
+  bc->server_addr.sin6_family = NGTCP2_AF_INET6;
+  bc->server_addr.sin6_port = htons(443);
+
+  conn_rand(bc->static_secret, sizeof(bc->static_secret), NULL);
+}
+
+static void bench_ctx_free(bench_ctx *bc) {
+  SSL_SESSION_free(bc->session);
+  SSL_CTX_free(bc->client_ssl_ctx);
+  SSL_CTX_free(bc->server_ssl_ctx);
+}
+
+static void callbacks_init(ngtcp2_callbacks *cb) {
+  memset(cb, 0, sizeof(*cb));
+  cb->client_initial = conn_client_initial;
+  cb->recv_client_initial = conn_recv_client_initial;
+  cb->recv_crypto_data = conn_recv_crypto_data;
+  cb->encrypt = ngtcp2_crypto_encrypt_cb;
+  cb->decrypt = ngtcp2_crypto_decrypt_cb;
+  cb->hp_mask = ngtcp2_crypto_hp_mask_cb;
+  cb->recv_retry = ngtcp2_crypto_recv_retry_cb;
+  cb->rand = conn_rand;
+  cb->get_new_connection_id = conn_get_new_connection_id;
+  cb->update_key = ngtcp2_crypto_update_key_cb;
+  cb->delete_crypto_aead_ctx = ngtcp2_crypto_delete_crypto_aead_ctx_cb;
+  cb->delete_crypto_cipher_ctx = ngtcp2_crypto_delete_crypto_cipher_ctx_cb;
+  cb->get_path_challenge_data = ngtcp2_crypto_get_path_challenge_data_cb;
+}
+
+static void transport_params_init(ngtcp2_transport_params *params) {
+  ngtcp2_transport_params_default(params);
+  params->initial_max_stream_data_bidi_local = 256 * 1024;
+  params->initial_max_stream_data_bidi_remote = 256 * 1024;
+  params->initial_max_data = 1024 * 1024;
+  params->initial_max_streams_bidi = 100;
+}
+
+static void client_init(bench_endpoint *client, bench_ctx *bc,
+                        bench_mode mode, ngtcp2_tstamp ts) {
+  ngtcp2_callbacks cb;
+  ngtcp2_settings settings;
+  ngtcp2_transport_params params;
+  ngtcp2_cid dcid, scid;
+  uint64_t t;
+
+  memset(client, 0, sizeof(*client));
+  client->conn_ref.get_conn = get_conn;
+  client->conn_ref.user_data = client;
+  client->stream_id = -1;
+
+  client->ssl = SSL_new(bc->client_ssl_ctx);
+  if (!client->ssl) {
+    check(-1, "SSL_new");
+  }
+
+  SSL_set_app_data(client->ssl, &client->conn_ref);
+  SSL_set_connect_state(client->ssl);
+  SSL_set_quic_use_legacy_codepoint(client->ssl, 0);
+  SSL_set_alpn_protos(client->ssl, alpn, sizeof(alpn) - 1);
+  SSL_set_tlsext_host_name(client->ssl, "localhost");
+
+  if (mode != BENCH_MODE_FULL) {
+    SSL_set_session(client->ssl, bc->session);
+  }
+
+  if (mode == BENCH_MODE_0RTT) {
+    SSL_set_quic_early_data_enabled(client->ssl, 1);
+  }
+
+  ngtcp2_path_storage_init(&client->ps, (ngtcp2_sockaddr *)&bc->client_addr,
+                           sizeof(bc->client_addr),
+                           (ngtcp2_sockaddr *)&bc->server_addr,
+                           sizeof(bc->server_addr), NULL);
+
+  callbacks_init(&cb);
+
+  ngtcp2_settings_default(&settings);
+  settings.initial_ts = ts;
+
+  transport_params_init(&params);
+
+  conn_rand(dcid.data, NGTCP2_MIN_INITIAL_DCIDLEN, NULL);
+  dcid.datalen = NGTCP2_MIN_INITIAL_DCIDLEN;
+
+  t = timestamp_ns();
+  conn_rand(scid.data, NGTCP2_MIN_INITIAL_DCIDLEN, NULL);
+  scid.datalen = NGTCP2_MIN_INITIAL_DCIDLEN;
+  phases.cid += timestamp_ns() - t;
+
+  check(ngtcp2_conn_client_new(&client->conn, &dcid, &scid, &client->ps.path,
+                               NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
+                               NULL, client),
+        "ngtcp2_conn_client_new");
+
+  ngtcp2_conn_set_tls_native_handle(client->conn, client->ssl);
+
+  if (mode == BENCH_MODE_0RTT) {
+    ngtcp2_conn_set_early_remote_transport_params(client->conn,
+                                                  &bc->early_params);
+
+    check(ngtcp2_conn_open_bidi_stream(client->conn, &client->stream_id, NULL),
+          "ngtcp2_conn_open_bidi_stream");
+  }
+}
+
+/*
+ * server_init creates a server from the first Initial packet |pkt|
+ * of length |pktlen| from the client.
+ */
+static void server_init(bench_endpoint *server, bench_ctx *bc,
+                        const uint8_t *pkt, size_t pktlen, ngtcp2_tstamp ts) {
+  ngtcp2_callbacks cb;
+  ngtcp2_settings settings;
+  ngtcp2_transport_params params;
+  ngtcp2_pkt_hd hd;
+  ngtcp2_cid scid;
+
+  check(ngtcp2_accept(&hd, pkt, pktlen), "ngtcp2_accept");
+
+  server->conn_ref.get_conn = get_conn;
+  server->conn_ref.user_data = server;
+  server->stream_id = -1;
+
+  server->ssl = SSL_new(bc->server_ssl_ctx);
+  if (!server->ssl) {
+    check(-1, "SSL_new");
+  }
+
+  SSL_set_app_data(server->ssl, &server->conn_ref);
+  SSL_set_accept_state(server->ssl);
+  SSL_set_quic_early_data_enabled(server->ssl, 1);
+
+  ngtcp2_path_storage_init(&server->ps, (ngtcp2_sockaddr *)&bc->server_addr,
+                           sizeof(bc->server_addr),
+                           (ngtcp2_sockaddr *)&bc->client_addr,
+                           sizeof(bc->client_addr), NULL);
+
+  callbacks_init(&cb);
+
+  ngtcp2_settings_default(&settings);
+  settings.initial_ts = ts;
+
+  transport_params_init(&params);
+  params.original_dcid = hd.dcid;
+  params.stateless_reset_token_present = 1;
+
+  check(generate_cid(&scid, params.stateless_reset_token,
+                     BENCH_SCIDLEN, bc),
+        "generate_cid");
+
+  check(ngtcp2_conn_server_new(&server->conn, &hd.scid, &scid,
+                               &server->ps.path, hd.version, &cb, &settings,
+                               &params, NULL, server),
+        "ngtcp2_conn_server_new");
+
+  ngtcp2_conn_set_tls_native_handle(server->conn, server->ssl);
+}
+
+static void endpoint_free(bench_endpoint *ep) {
+  ngtcp2_conn_del(ep->conn);
+  SSL_free(ep->ssl);
+}
+
+/*
+ * flush writes packets from |ep| and feeds them to |peer|.  If
+ * |peer| has not been created yet, it is created from the first
+ * packet as a server.  It returns the number of packets written.
+ */
+static size_t flush(bench_endpoint *ep, bench_endpoint *peer, bench_ctx *bc,
+                    ngtcp2_tstamp ts) {
+  static const uint8_t req[] = "GET /\r\n";
+  uint8_t buf[BENCH_MAX_PKTLEN];
+  ngtcp2_pkt_info pi = {0};
+  ngtcp2_vec datav;
+  ngtcp2_ssize nwrite, ndatalen;
+  size_t n = 0;
+  int rv;
+
+  datav.base = (uint8_t *)req;
+  datav.len = sizeof(req) - 1;
+
+  for (;;) {
+    nwrite = ngtcp2_conn_writev_stream(
+        ep->conn, NULL, NULL, buf, sizeof(buf), &ndatalen,
+        NGTCP2_WRITE_STREAM_FLAG_FIN, ep->stream_id, &datav,
+        ep->stream_id == -1 ? 0 : 1, ts);
+    if (nwrite < 0) {
+      if (nwrite == NGTCP2_ERR_STREAM_DATA_BLOCKED) {
+        ep->stream_id = -1;
+        continue;
+      }
+
+      check((int)nwrite, "ngtcp2_conn_writev_stream");
+    }
+
+    if (ndatalen >= 0) {
+      ep->stream_id = -1;
+    }
+
+    if (nwrite == 0) {
+      return n;
+    }
+
+    ++n;
+
+    if (!peer->conn) {
+      server_init(peer, bc, buf, (size_t)nwrite, ts);
+    }
+
+    rv = ngtcp2_conn_read_pkt(peer->conn, &peer->ps.path, &pi, buf,
+                              (size_t)nwrite, ts);
+    check(rv, "ngtcp2_conn_read_pkt");
+  }
+}
+
+/*
+ * handshake performs a single handshake in |mode|.  If |prime| is
+ * nonzero, it waits for a session ticket, and remembers the server's
+ * transport parameters for 0-RTT.
+ */
+static void handshake(bench_ctx *bc, bench_mode mode, int prime) {
+  bench_endpoint client, server;
+  ngtcp2_tstamp ts;
+  size_t i;
+
+  memset(&server, 0, sizeof(server));
+
+  client_init(&client, bc, mode, timestamp_ns());
+
+  for (i = 0; i < BENCH_MAX_ROUNDTRIPS; ++i) {
+    ts = timestamp_ns();
+
+    flush(&client, &server, bc, ts);
+    if (!server.conn) {
+      break;
+    }
+
+    flush(&server, &client, bc, ts);
+
+    if (ngtcp2_conn_get_handshake_completed(client.conn) &&
+        ngtcp2_conn_get_handshake_completed(server.conn) &&
+        (!prime || bc->session)) {
+      break;
+    }
+  }
+
+  if (!server.conn || !ngtcp2_conn_get_handshake_completed(client.conn) ||
+      !ngtcp2_conn_get_handshake_completed(server.conn) ||
+      (prime && !bc->session)) {
+    fprintf(stderr, "bench_handshake: handshake did not complete\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (mode == BENCH_MODE_0RTT) {
+    if (SSL_get_early_data_status(client.ssl) == SSL_EARLY_DATA_ACCEPTED) {
+      ++bc->nearly_data_accepted;
+    } else {
+      ngtcp2_conn_early_data_rejected(client.conn);
+    }
+  }
+
+  if (prime) {
+    bc->early_params = *ngtcp2_conn_get_remote_transport_params(client.conn);
+    /* version_info points to the memory owned by the connection,
+       and ngtcp2_conn_set_early_remote_transport_params does not use
+       it. */
+    bc->early_params.version_info_present = 0;
+  }
+
+  endpoint_free(&client);
+  endpoint_free(&server);
+}
+
+static void print_usage(void) {
+  printf("Usage: bench_handshake [OPTIONS] <PRIVATE_KEY_FILE> <CERT_FILE>\n"
+         "                       [PATTERN...]\n"
+         "Run the benchmarks whose name contains one of PATTERNs, or all\n"
+         "benchmarks if no PATTERN is given.  The result is written to\n"
+         "stdout in JSON.\n"
+         "Options:\n"
+         "  -n, --handshakes=<N>\n"
+         "                    The number of handshakes in each round.\n"
+         "                    Default: 1000\n"
+         "  -r, --rounds=<N>  The number of times each benchmark is run.\n"
+         "                    Default: 5\n"
+         "  -l, --list        List benchmarks and exit.\n"
+         "  -h, --help        Display this help and exit.\n");
+}
+
+static int match(const char *name, char **patterns, size_t npatterns) {
+  size_t i;
+
+  if (npatterns == 0) {
+    return 1;
+  }
+
+  for (i = 0; i < npatterns; ++i) {
+    if (strstr(name, patterns[i])) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  size_t rounds = 5;
+  size_t n = 1000;
+  bench_ctx bc;
+  bench_phases best_phases;
+  uint64_t ns, best, sum;
+  size_t i, j, r;
+  int first = 1;
+
+  for (;;) {
+    static struct option long_opts[] = {
+        {"handshakes", required_argument, NULL, 'n'},
+        {"rounds", required_argument, NULL, 'r'},
+        {"list", no_argument, NULL, 'l'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int optidx = 0;
+    int c = getopt_long(argc, argv, "n:r:lh", long_opts, &optidx);
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case 'n':
+      n = (size_t)strtoul(optarg, NULL, 10);
+      if (n == 0) {
+        fprintf(stderr, "bench_handshake: handshakes must be positive\n");
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'r':
+      rounds = (size_t)strtoul(optarg, NULL, 10);
+      if (rounds == 0) {
+        fprintf(stderr, "bench_handshake: rounds must be positive\n");
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'l':
+      for (i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i) {
+        printf("%s\n", benches[i].name);
+      }
+      return EXIT_SUCCESS;
+    case 'h':
+      print_usage();
+      return EXIT_SUCCESS;
+    default:
+      print_usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (argc - optind < 2) {
+    print_usage();
+    return EXIT_FAILURE;
+  }
+
+  check(ngtcp2_crypto_openssl_init(), "ngtcp2_crypto_openssl_init");
+
+  bench_ctx_init(&bc, argv[optind], argv[optind + 1]);
+  bctx = &bc;
+
+  optind += 2;
+
+  /* Obtain a session ticket and the transport parameters for the
+     resumed and 0-RTT handshakes. */
+  handshake(&bc, BENCH_MODE_FULL, 1);
+
+  printf("{\n"
+         "  \"version\": \"%s\",\n"
+         "  \"backend\": \"openssl\",\n"
+         "  \"rounds\": %zu,\n"
+         "  \"benchmarks\": [",
+         ngtcp2_version(0)->version_str, rounds);
+
+  for (i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i) {
+    if (!match(benches[i].name, argv + optind, (size_t)(argc - optind))) {
+      continue;
+    }
+
+    best = UINT64_MAX;
+    sum = 0;
+    memset(&best_phases, 0, sizeof(best_phases));
+    bc.nearly_data_accepted = 0;
+
+    for (r = 0; r < rounds; ++r) {
+      memset(&phases, 0, sizeof(phases));
+
+      ns = timestamp_ns();
+      for (j = 0; j < n; ++j) {
+        handshake(&bc, benches[i].mode, 0);
+      }
+      ns = timestamp_ns() - ns;
+
+      if (ns < best) {
+        best = ns;
+        best_phases = phases;
+      }
+      sum += ns;
+    }
+
+    printf("%s\n"
+           "    {\n"
+           "      \"name\": \"%s\",\n"
+           "      \"n\": %zu,\n"
+           "      \"best_ns\": %" PRIu64 ",\n"
+           "      \"mean_ns\": %" PRIu64 ",\n"
+           "      \"best_ns_per_op\": %.2f,\n"
+           "      \"handshakes_per_sec\": %.2f,\n"
+           "      \"initial_ns_per_op\": %.2f,\n"
+           "      \"tls_ns_per_op\": %.2f,\n"
+           "      \"transport_params_ns_per_op\": %.2f,\n"
+           "      \"cid_ns_per_op\": %.2f",
+           first ? "" : ",", benches[i].name, n, best, sum / rounds,
+           (double)best / (double)n, (double)n * 1e9 / (double)best,
+           (double)best_phases.initial / (double)n,
+           (double)best_phases.tls / (double)n,
+           (double)best_phases.transport_params / (double)n,
+           (double)best_phases.cid / (double)n);
+
+    if (benches[i].mode == BENCH_MODE_0RTT) {
+      printf(",\n"
+             "      \"early_data_accepted\": %" PRIu64,
+             bc.nearly_data_accepted);
+    }
+
+    printf("\n"
+           "    }");
+
+    first = 0;
+  }
+
+  printf("\n  ]\n}\n");
+
+  bench_ctx_free(&bc);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,651 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * bench_loopback measures the bulk transfer throughput of a pair of
+ * ngtcp2_conn, a client and a server, which are connected with each
+ * other by an in-memory link inside a single thread.  The client
+ * sends a single stream to the server.  The packets are protected by
+ * the crypto backend which bench_loopback is linked to, using
+ * AES-128-GCM and AES-128 header protection.  The TLS handshake is
+ * not performed; the connections are created in the post-handshake
+ * state and 1-RTT keys are derived from the fixed secrets.  The
+ * benchmark is run for each congestion controller, and the result is
+ * written to stdout in JSON in the same format as bench.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <ngtcp2/ngtcp2_crypto.h>
+
+#ifdef NGTCP2_BENCH_CRYPTO_OPENSSL
+#  include <ngtcp2/ngtcp2_crypto_openssl.h>
+#endif /* NGTCP2_BENCH_CRYPTO_OPENSSL */
+
+#include "shared.h"
+#include "bench_loopback_conn.h"
+
+#ifndef NGTCP2_BENCH_CRYPTO_BACKEND
+#  define NGTCP2_BENCH_CRYPTO_BACKEND "unknown"
+#endif /* !NGTCP2_BENCH_CRYPTO_BACKEND */
+
+/* BENCH_MAX_PKTLEN is the maximum size of a packet which travels
+   through the link. */
+#define BENCH_MAX_PKTLEN 1500
+/* BENCH_LINK_QLEN is the maximum number of packets which the link
+   holds in each direction.  A sender stops writing when the queue is
+   full as if it got EAGAIN from a socket. */
+#define BENCH_LINK_QLEN 1024
+/* BENCH_WINDOW is the flow control window of the connection and the
+   stream. */
+#define BENCH_WINDOW (16 * 1024 * 1024)
+#define BENCH_SECRETLEN 32
+
+typedef struct bench_cc {
+  const char *name;
+  ngtcp2_cc_algo cc_algo;
+} bench_cc;
+
+static const bench_cc ccs[] = {
+    {"reno", NGTCP2_CC_ALGO_RENO},   {"cubic", NGTCP2_CC_ALGO_CUBIC},
+    {"bbr", NGTCP2_CC_ALGO_BBR},     {"bbr2", NGTCP2_CC_ALGO_BBR2},
+    {"prague", NGTCP2_CC_ALGO_PRAGUE},
+};
+
+/*
+ * bench_link is a FIFO queue of packets in one direction.
+ */
+typedef struct bench_link {
+  uint8_t pkts[BENCH_LINK_QLEN][BENCH_MAX_PKTLEN];
+  size_t pktlens[BENCH_LINK_QLEN];
+  size_t head;
+  size_t len;
+} bench_link;
+
+/*
+ * bench_alloc counts the number of allocations made through
+ * ngtcp2_mem.
+ */
+typedef struct bench_alloc {
+  uint64_t nalloc;
+} bench_alloc;
+
+typedef struct bench_endpoint {
+  ngtcp2_conn *conn;
+  ngtcp2_path_storage ps;
+  /* nrecv is the number of bytes of stream data received. */
+  uint64_t nrecv;
+  /* fin is nonzero if the end of stream has been received. */
+  int fin;
+} bench_endpoint;
+
+typedef struct bench_result {
+  uint64_t ns;
+  uint64_t npkt;
+  uint64_t nalloc;
+} bench_result;
+
+static uint8_t stream_data[256 * 1024];
+
+static uint64_t timestamp_ns(void) {
+  struct timespec tp;
+
+  clock_gettime(CLOCK_MONOTONIC, &tp);
+
+  return (uint64_t)tp.tv_sec * 1000000000 + (uint64_t)tp.tv_nsec;
+}
+
+static void check(int rv, const char *what) {
+  if (rv != 0) {
+    fprintf(stderr, "bench_loopback: %s failed: %d\n", what, rv);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void *alloc_malloc(size_t size, void *user_data) {
+  ++((bench_alloc *)user_data)->nalloc;
+
+  return malloc(size);
+}
+
+static void alloc_free(void *ptr, void *user_data) {
+  (void)user_data;
+
+  free(ptr);
+}
+
+static void *alloc_calloc(size_t nmemb, size_t size, void *user_data) {
+  ++((bench_alloc *)user_data)->nalloc;
+
+  return calloc(nmemb, size);
+}
+
+static void *alloc_realloc(void *ptr, size_t size, void *user_data) {
+  ++((bench_alloc *)user_data)->nalloc;
+
+  return realloc(ptr, size);
+}
+
+static uint64_t bench_rand_state;
+
+static void conn_rand(uint8_t *dest, size_t destlen,
+                      const ngtcp2_rand_ctx *rand_ctx) {
+  size_t i;
+  (void)rand_ctx;
+
+  for (i = 0; i < destlen; ++i) {
+    bench_rand_state = bench_rand_state * 6364136223846793005ULL + 1;
+    dest[i] = (uint8_t)(bench_rand_state >> 56);
+  }
+}
+
+static int conn_client_initial(ngtcp2_conn *conn, void *user_data) {
+  (void)conn;
+  (void)user_data;
+
+  return 0;
+}
+
+static int conn_recv_client_initial(ngtcp2_conn *conn, const ngtcp2_cid *dcid,
+                                    void *user_data) {
+  (void)conn;
+  (void)dcid;
+  (void)user_data;
+
+  return 0;
+}
+
+static int conn_recv_crypto_data(ngtcp2_conn *conn,
+                                 ngtcp2_crypto_level crypto_level,
+                                 uint64_t offset, const uint8_t *data,
+                                 size_t datalen, void *user_data) {
+  (void)conn;
+  (void)crypto_level;
+  (void)offset;
+  (void)data;
+  (void)datalen;
+  (void)user_data;
+
+  return 0;
+}
+
+static int conn_recv_retry(ngtcp2_conn *conn, const ngtcp2_pkt_hd *hd,
+                           void *user_data) {
+  (void)conn;
+  (void)hd;
+  (void)user_data;
+
+  return 0;
+}
+
+static int conn_get_new_connection_id(ngtcp2_conn *conn, ngtcp2_cid *cid,
+                                      uint8_t *token, size_t cidlen,
+                                      void *user_data) {
+  (void)conn;
+  (void)user_data;
+
+  conn_rand(cid->data, cidlen, NULL);
+  cid->datalen = cidlen;
+  conn_rand(token, NGTCP2_STATELESS_RESET_TOKENLEN, NULL);
+
+  return 0;
+}
+
+static int conn_recv_stream_data(ngtcp2_conn *conn, uint32_t flags,
+                                 int64_t stream_id, uint64_t offset,
+                                 const uint8_t *data, size_t datalen,
+                                 void *user_data, void *stream_user_data) {
+  bench_endpoint *ep = user_data;
+  (void)offset;
+  (void)data;
+  (void)stream_user_data;
+
+  ep->nrecv += datalen;
+
+  if (flags & NGTCP2_STREAM_DATA_FLAG_FIN) {
+    ep->fin = 1;
+  }
+
+  ngtcp2_conn_extend_max_stream_offset(conn, stream_id, datalen);
+  ngtcp2_conn_extend_max_offset(conn, datalen);
+
+  return 0;
+}
+
+/*
+ * install_key installs 1-RTT keys derived from |rx_secret| and
+ * |tx_secret| to |conn|.
+ */
+static void install_key(ngtcp2_conn *conn, const uint8_t *rx_secret,
+                        const uint8_t *tx_secret) {
+  static uint8_t null_iv[16];
+  ngtcp2_crypto_ctx ctx;
+  ngtcp2_crypto_aead_ctx aead_ctx = {0};
+  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
+  uint8_t key[16], iv[NGTCP2_CRYPTO_INITIAL_IVLEN], hp_key[16];
+
+  ngtcp2_crypto_ctx_initial(&ctx);
+  ctx.max_encryption = NGTCP2_CRYPTO_MAX_ENCRYPTION_AES_GCM;
+  ctx.max_decryption_failure = NGTCP2_CRYPTO_MAX_DECRYPTION_FAILURE_AES_GCM;
+
+  ngtcp2_conn_set_crypto_ctx(conn, &ctx);
+
+  /* Handshake keys are never used because the handshake has been
+     confirmed, but ngtcp2_conn expects them. */
+  check(ngtcp2_conn_install_rx_handshake_key(conn, &aead_ctx, null_iv,
+                                             sizeof(null_iv), &hp_ctx),
+        "ngtcp2_conn_install_rx_handshake_key");
+  check(ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
+                                             sizeof(null_iv), &hp_ctx),
+        "ngtcp2_conn_install_tx_handshake_key");
+
+  check(ngtcp2_crypto_derive_packet_protection_key(
+            key, iv, hp_key, NGTCP2_PROTO_VER_V1, &ctx.aead, &ctx.md,
+            rx_secret, BENCH_SECRETLEN),
+        "ngtcp2_crypto_derive_packet_protection_key");
+  check(ngtcp2_crypto_aead_ctx_decrypt_init(&aead_ctx, &ctx.aead, key,
+                                            sizeof(iv)),
+        "ngtcp2_crypto_aead_ctx_decrypt_init");
+  check(ngtcp2_crypto_cipher_ctx_encrypt_init(&hp_ctx, &ctx.hp, hp_key),
+        "ngtcp2_crypto_cipher_ctx_encrypt_init");
+  check(ngtcp2_conn_install_rx_key(conn, rx_secret, BENCH_SECRETLEN,
+                                   &aead_ctx, iv, sizeof(iv), &hp_ctx),
+        "ngtcp2_conn_install_rx_key");
+
+  check(ngtcp2_crypto_derive_packet_protection_key(
+            key, iv, hp_key, NGTCP2_PROTO_VER_V1, &ctx.aead, &ctx.md,
+            tx_secret, BENCH_SECRETLEN),
+        "ngtcp2_crypto_derive_packet_protection_key");
+  check(ngtcp2_crypto_aead_ctx_encrypt_init(&aead_ctx, &ctx.aead, key,
+                                            sizeof(iv)),
+        "ngtcp2_crypto_aead_ctx_encrypt_init");
+  check(ngtcp2_crypto_cipher_ctx_encrypt_init(&hp_ctx, &ctx.hp, hp_key),
+        "ngtcp2_crypto_cipher_ctx_encrypt_init");
+  check(ngtcp2_conn_install_tx_key(conn, tx_secret, BENCH_SECRETLEN,
+                                   &aead_ctx, iv, sizeof(iv), &hp_ctx),
+        "ngtcp2_conn_install_tx_key");
+}
+
+/*
+ * endpoints_init creates a client in |client| and a server in
+ * |server| which allocate memory from |mem| and use |cc_algo|.
+ */
+static void endpoints_init(bench_endpoint *client, bench_endpoint *server,
+                           ngtcp2_cc_algo cc_algo, const ngtcp2_mem *mem,
+                           ngtcp2_tstamp ts) {
+  static uint8_t c2s_secret[BENCH_SECRETLEN] = {0xc2};
+  static uint8_t s2c_secret[BENCH_SECRETLEN] = {0x5c};
+  ngtcp2_callbacks cb;
+  ngtcp2_settings settings;
+  ngtcp2_transport_params params;
+  ngtcp2_cid client_scid, server_scid;
+  ngtcp2_sockaddr_in6 client_addr, server_addr;
+
+  memset(&cb, 0, sizeof(cb));
+  cb.client_initial = conn_client_initial;
+  cb.recv_client_initial = conn_recv_client_initial;
+  cb.recv_crypto_data = conn_recv_crypto_data;
+  cb.recv_retry = conn_recv_retry;
+  cb.encrypt = ngtcp2_crypto_encrypt_cb;
+  cb.decrypt = ngtcp2_crypto_decrypt_cb;
+  cb.hp_mask = ngtcp2_crypto_hp_mask_cb;
+  cb.rand = conn_rand;
+  cb.get_new_connection_id = conn_get_new_connection_id;
+  cb.update_key = ngtcp2_crypto_update_key_cb;
+  cb.delete_crypto_aead_ctx = ngtcp2_crypto_delete_crypto_aead_ctx_cb;
+  cb.delete_crypto_cipher_ctx = ngtcp2_crypto_delete_crypto_cipher_ctx_cb;
+  cb.get_path_challenge_data = ngtcp2_crypto_get_path_challenge_data_cb;
+  cb.recv_stream_data = conn_recv_stream_data;
+
+  ngtcp2_settings_default(&settings);
+  settings.initial_ts = ts;
+  settings.cc_algo = cc_algo;
+
+  ngtcp2_transport_params_default(&params);
+  params.initial_max_stream_data_bidi_local = BENCH_WINDOW;
+  params.initial_max_stream_data_bidi_remote = BENCH_WINDOW;
+  params.initial_max_data = BENCH_WINDOW;
+  params.initial_max_streams_bidi = 1;
+
+  conn_rand(client_scid.data, NGTCP2_MIN_INITIAL_DCIDLEN, NULL);
+  client_scid.datalen = NGTCP2_MIN_INITIAL_DCIDLEN;
+  conn_rand(server_scid.data, NGTCP2_MIN_INITIAL_DCIDLEN, NULL);
+  server_scid.datalen = NGTCP2_MIN_INITIAL_DCIDLEN;
+
+  memset(&client_addr, 0, sizeof(client_addr));
+  client_addr.sin6_family = NGTCP2_AF_INET6;
+  client_addr.sin6_port = htons(44300);
+  memset(&server_addr, 0, sizeof(server_addr));
+  server_addr.sin6_family = NGTCP2_AF_INET6;
+  server_addr.sin6_port = htons(443);
+
+  memset(client, 0, sizeof(*client));
+  ngtcp2_path_storage_init(&client->ps, (ngtcp2_sockaddr *)&client_addr,
+                           sizeof(client_addr),
+                           (ngtcp2_sockaddr *)&server_addr,
+                           sizeof(server_addr), NULL);
+  check(ngtcp2_conn_client_new(&client->conn, &server_scid, &client_scid,
+                               &client->ps.path, NGTCP2_PROTO_VER_V1, &cb,
+                               &settings, &params, mem, client),
+        "ngtcp2_conn_client_new");
+  install_key(client->conn, s2c_secret, c2s_secret);
+  check(bench_conn_complete_handshake(client->conn, &params),
+        "bench_conn_complete_handshake");
+
+  memset(server, 0, sizeof(*server));
+  ngtcp2_path_storage_init(&server->ps, (ngtcp2_sockaddr *)&server_addr,
+                           sizeof(server_addr),
+                           (ngtcp2_sockaddr *)&client_addr,
+                           sizeof(client_addr), NULL);
+  check(ngtcp2_conn_server_new(&server->conn, &client_scid, &server_scid,
+                               &server->ps.path, NGTCP2_PROTO_VER_V1, &cb,
+                               &settings, &params, mem, server),
+        "ngtcp2_conn_server_new");
+  install_key(server->conn, c2s_secret, s2c_secret);
+  check(bench_conn_complete_handshake(server->conn, &params),
+        "bench_conn_complete_handshake");
+}
+
+static void handle_expiry(bench_endpoint *ep, ngtcp2_tstamp ts) {
+  if (ngtcp2_conn_get_expiry(ep->conn) <= ts) {
+    check(ngtcp2_conn_handle_expiry(ep->conn, ts), "ngtcp2_conn_handle_expiry");
+  }
+}
+
+/*
+ * deliver feeds all packets in |link| to |ep|.
+ */
+static void deliver(bench_endpoint *ep, bench_link *link, ngtcp2_tstamp ts) {
+  ngtcp2_pkt_info pi = {0};
+
+  for (; link->len; --link->len) {
+    check(ngtcp2_conn_read_pkt(ep->conn, &ep->ps.path, &pi,
+                               link->pkts[link->head],
+                               link->pktlens[link->head], ts),
+          "ngtcp2_conn_read_pkt");
+
+    link->head = (link->head + 1) % BENCH_LINK_QLEN;
+  }
+}
+
+/*
+ * write_pkts writes packets from |ep| to |link| until there is
+ * nothing to send, or |link| is full.  If |stream_id| is not -1, the
+ * stream data up to |*poffset| < |size| is sent on it.  It returns
+ * the number of packets written.
+ */
+static size_t write_pkts(bench_endpoint *ep, bench_link *link,
+                         int64_t stream_id, uint64_t *poffset, uint64_t size,
+                         ngtcp2_tstamp ts) {
+  ngtcp2_vec datav;
+  ngtcp2_ssize nwrite, ndatalen;
+  size_t tail, n = 0;
+  uint32_t flags;
+  uint64_t offset;
+
+  while (link->len < BENCH_LINK_QLEN) {
+    tail = (link->head + link->len) % BENCH_LINK_QLEN;
+
+    datav.len = 0;
+    flags = 0;
+
+    if (stream_id != -1 && *poffset < size) {
+      offset = *poffset % sizeof(stream_data);
+      datav.base = stream_data + offset;
+      datav.len = sizeof(stream_data) - offset;
+      if (datav.len > size - *poffset) {
+        datav.len = (size_t)(size - *poffset);
+      }
+      if (*poffset + datav.len == size) {
+        flags |= NGTCP2_WRITE_STREAM_FLAG_FIN;
+      }
+    }
+
+    nwrite = ngtcp2_conn_writev_stream(
+        ep->conn, NULL, NULL, link->pkts[tail], BENCH_MAX_PKTLEN, &ndatalen,
+        flags, datav.len ? stream_id : -1, &datav, datav.len ? 1 : 0, ts);
+    if (nwrite < 0) {
+      if (nwrite == NGTCP2_ERR_STREAM_DATA_BLOCKED) {
+        stream_id = -1;
+        continue;
+      }
+
+      check((int)nwrite, "ngtcp2_conn_writev_stream");
+    }
+
+    if (ndatalen > 0) {
+      *poffset += (uint64_t)ndatalen;
+    }
+
+    if (nwrite == 0) {
+      break;
+    }
+
+    link->pktlens[tail] = (size_t)nwrite;
+    ++link->len;
+    ++n;
+  }
+
+  ngtcp2_conn_update_pkt_tx_time(ep->conn, ts);
+
+  return n;
+}
+
+/*
+ * bench_loopback_run sends |size| bytes of stream data from the
+ * client to the server with |cc_algo|.
+ */
+static void bench_loopback_run(bench_result *res, ngtcp2_cc_algo cc_algo,
+                               uint64_t size) {
+  static bench_link c2s, s2c;
+  bench_endpoint client, server;
+  bench_alloc alloc = {0};
+  ngtcp2_mem mem = {
+      &alloc, alloc_malloc, alloc_free, alloc_calloc, alloc_realloc,
+  };
+  ngtcp2_tstamp ts, start;
+  uint64_t offset = 0;
+  int64_t stream_id;
+
+  c2s.head = c2s.len = 0;
+  s2c.head = s2c.len = 0;
+
+  start = timestamp_ns();
+
+  endpoints_init(&client, &server, cc_algo, &mem, start);
+
+  check(ngtcp2_conn_open_bidi_stream(client.conn, &stream_id, NULL),
+        "ngtcp2_conn_open_bidi_stream");
+
+  res->npkt = 0;
+  alloc.nalloc = 0;
+
+  while (!server.fin) {
+    ts = timestamp_ns();
+
+    handle_expiry(&client, ts);
+    res->npkt += write_pkts(&client, &c2s, stream_id, &offset, size, ts);
+    deliver(&server, &c2s, ts);
+
+    handle_expiry(&server, ts);
+    write_pkts(&server, &s2c, -1, NULL, 0, ts);
+    deliver(&client, &s2c, ts);
+  }
+
+  res->ns = timestamp_ns() - start;
+  res->nalloc = alloc.nalloc;
+
+  if (server.nrecv != size) {
+    fprintf(stderr,
+            "bench_loopback: received %" PRIu64 " bytes, want %" PRIu64 "\n",
+            server.nrecv, size);
+    exit(EXIT_FAILURE);
+  }
+
+  ngtcp2_conn_del(client.conn);
+  ngtcp2_conn_del(server.conn);
+}
+
+static void print_usage(void) {
+  printf("Usage: bench_loopback [OPTIONS] [PATTERN...]\n"
+         "Run the benchmarks for the congestion controllers whose name\n"
+         "contains one of PATTERNs, or all congestion controllers if no\n"
+         "PATTERN is given.  The result is written to stdout in JSON.\n"
+         "Options:\n"
+         "  -r, --rounds=<N>  The number of times each benchmark is run.\n"
+         "                    Default: 5\n"
+         "  -s, --size=<N>    The number of megabytes sent in each run.\n"
+         "                    Default: 256\n"
+         "  -l, --list        List benchmarks and exit.\n"
+         "  -h, --help        Display this help and exit.\n");
+}
+
+static int match(const char *name, char **patterns, size_t npatterns) {
+  size_t i;
+
+  if (npatterns == 0) {
+    return 1;
+  }
+
+  for (i = 0; i < npatterns; ++i) {
+    if (strstr(name, patterns[i])) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  size_t rounds = 5;
+  uint64_t size = 256;
+  bench_result res, best;
+  uint64_t sum;
+  double mb;
+  size_t i, r;
+  int first = 1;
+
+  for (;;) {
+    static struct option long_opts[] = {
+        {"rounds", required_argument, NULL, 'r'},
+        {"size", required_argument, NULL, 's'},
+        {"list", no_argument, NULL, 'l'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int optidx = 0;
+    int c = getopt_long(argc, argv, "r:s:lh", long_opts, &optidx);
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case 'r':
+      rounds = (size_t)strtoul(optarg, NULL, 10);
+      if (rounds == 0) {
+        fprintf(stderr, "bench_loopback: rounds must be positive\n");
+        return EXIT_FAILURE;
+      }
+      break;
+    case 's':
+      size = strtoull(optarg, NULL, 10);
+      if (size == 0) {
+        fprintf(stderr, "bench_loopback: size must be positive\n");
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'l':
+      for (i = 0; i < sizeof(ccs) / sizeof(ccs[0]); ++i) {
+        printf("loopback_%s\n", ccs[i].name);
+      }
+      return EXIT_SUCCESS;
+    case 'h':
+      print_usage();
+      return EXIT_SUCCESS;
+    default:
+      print_usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+#ifdef NGTCP2_BENCH_CRYPTO_OPENSSL
+  check(ngtcp2_crypto_openssl_init(), "ngtcp2_crypto_openssl_init");
+#endif /* NGTCP2_BENCH_CRYPTO_OPENSSL */
+
+  mb = (double)size;
+  size *= 1024 * 1024;
+
+  printf("{\n"
+         "  \"version\": \"%s\",\n"
+         "  \"backend\": \"%s\",\n"
+         "  \"rounds\": %zu,\n"
+         "  \"bytes\": %" PRIu64 ",\n"
+         "  \"benchmarks\": [",
+         ngtcp2_version(0)->version_str, NGTCP2_BENCH_CRYPTO_BACKEND, rounds,
+         size);
+
+  for (i = 0; i < sizeof(ccs) / sizeof(ccs[0]); ++i) {
+    if (!match(ccs[i].name, argv + optind, (size_t)(argc - optind))) {
+      continue;
+    }
+
+    bench_rand_state = 0;
+    memset(&best, 0, sizeof(best));
+    best.ns = UINT64_MAX;
+    sum = 0;
+
+    for (r = 0; r < rounds; ++r) {
+      bench_loopback_run(&res, ccs[i].cc_algo, size);
+      if (res.ns < best.ns) {
+        best = res;
+      }
+      sum += res.ns;
+    }
+
+    printf("%s\n"
+           "    {\n"
+           "      \"name\": \"loopback_%s\",\n"
+           "      \"pkts\": %" PRIu64 ",\n"
+           "      \"best_ns\": %" PRIu64 ",\n"
+           "      \"mean_ns\": %" PRIu64 ",\n"
+           "      \"gbps\": %.3f,\n"
+           "      \"ns_per_pkt\": %.2f,\n"
+           "      \"allocs_per_mb\": %.2f\n"
+           "    }",
+           first ? "" : ",", ccs[i].name, best.npkt, best.ns, sum / rounds,
+           (double)size * 8 / (double)best.ns,
+           best.npkt ? (double)best.ns / (double)best.npkt : 0.,
+           (double)best.nalloc / mb);
+
+    first = 0;
+  }
+
+  printf("\n  ]\n}\n");
+
+  return EXIT_SUCCESS;
+}
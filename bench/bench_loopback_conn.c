@@ -0,0 +1,68 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "bench_loopback_conn.h"
+
+#include "ngtcp2_conn.h"
+#include "ngtcp2_ksl.h"
+#include "ngtcp2_pq.h"
+
+int bench_conn_complete_handshake(ngtcp2_conn *conn,
+                                  const ngtcp2_transport_params *params) {
+  ngtcp2_scid *scid;
+  ngtcp2_ksl_it it;
+  int rv;
+
+  conn->state = NGTCP2_CS_POST_HANDSHAKE;
+  conn->flags |= NGTCP2_CONN_FLAG_CONN_ID_NEGOTIATED |
+                 NGTCP2_CONN_FLAG_HANDSHAKE_COMPLETED |
+                 NGTCP2_CONN_FLAG_HANDSHAKE_COMPLETED_HANDLED |
+                 NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED;
+  conn->dcid.current.flags |= NGTCP2_DCID_FLAG_PATH_VALIDATED;
+
+  it = ngtcp2_ksl_begin(&conn->scid.set);
+  scid = ngtcp2_ksl_it_get(&it);
+  scid->flags |= NGTCP2_SCID_FLAG_USED;
+
+  rv = ngtcp2_pq_push(&conn->scid.used, &scid->pe);
+  if (rv != 0) {
+    return rv;
+  }
+
+  rv = ngtcp2_transport_params_storage_copy(
+      &conn->remote.transport_params_storage[0], params, conn->mem);
+  if (rv != 0) {
+    return rv;
+  }
+
+  conn->remote.transport_params =
+      &conn->remote.transport_params_storage[0].params;
+
+  conn->local.bidi.max_streams = params->initial_max_streams_bidi;
+  conn->local.uni.max_streams = params->initial_max_streams_uni;
+  conn->tx.max_offset = params->initial_max_data;
+  conn->negotiated_version = conn->client_chosen_version;
+
+  return 0;
+}
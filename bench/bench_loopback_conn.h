@@ -0,0 +1,43 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef BENCH_LOOPBACK_CONN_H
+#define BENCH_LOOPBACK_CONN_H
+
+#include <ngtcp2/ngtcp2.h>
+
+/*
+ * bench_conn_complete_handshake puts |conn| into the state where the
+ * handshake has been confirmed in the same way as the unit tests do.
+ * |params| is the transport parameters of the remote endpoint.  It
+ * lives in its own translation unit because the internal headers
+ * cannot be included together with ngtcp2_crypto.h.
+ *
+ * This function returns 0 if it succeeds, or one of NGTCP2_ERR_*
+ * error codes.
+ */
+int bench_conn_complete_handshake(ngtcp2_conn *conn,
+                                  const ngtcp2_transport_params *params);
+
+#endif /* BENCH_LOOPBACK_CONN_H */
@@ -0,0 +1,754 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * bench_replay replays a packet trace recorded by the server example
+ * with --trace-dir against a fresh ngtcp2_conn, so that a performance
+ * problem seen in production can be profiled and bisected against the
+ * real traffic.  The connection is restored from the snapshot at the
+ * beginning of the trace with ngtcp2_conn_decode_and_set_snapshot,
+ * and then the recorded datagrams are fed to ngtcp2_conn_read_pkts
+ * with the recorded timestamps and paths.  The random source is a
+ * fixed PRNG, and nothing depends on the wall clock, so every run
+ * processes exactly the same input.
+ *
+ * The application data is not in the trace.  For each packet the
+ * original connection wrote, the replayed connection writes a packet
+ * with ngtcp2_conn_write_pkt, or a PING with
+ * ngtcp2_conn_write_keep_alive if it has nothing to send, so that
+ * the packet numbers line up and the recorded ACKs acknowledge the
+ * packets which the replayed connection has sent.  The processing of
+ * incoming packets, ACKs, loss detection, and the congestion
+ * controller therefore follow the recorded traffic closely, but not
+ * byte for byte.  If the replayed connection fails to process a
+ * record, the replay stops there and the index of the record is
+ * reported.
+ *
+ * Only TLS_AES_128_GCM_SHA256 is supported.  The result is written to
+ * stdout in JSON.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <sys/socket.h>
+
+#include <ngtcp2/ngtcp2_crypto.h>
+
+#ifdef NGTCP2_BENCH_CRYPTO_OPENSSL
+#  include <ngtcp2/ngtcp2_crypto_openssl.h>
+#endif /* NGTCP2_BENCH_CRYPTO_OPENSSL */
+
+#include "shared.h"
+
+#ifndef NGTCP2_BENCH_CRYPTO_BACKEND
+#  define NGTCP2_BENCH_CRYPTO_BACKEND "unknown"
+#endif /* !NGTCP2_BENCH_CRYPTO_BACKEND */
+
+/* These must match PktTraceType in examples/pkt_trace.h. */
+#define REPLAY_TRACE_START 0x01
+#define REPLAY_TRACE_RECV 0x02
+#define REPLAY_TRACE_SEND 0x03
+#define REPLAY_TRACE_EXPIRY 0x04
+
+#define REPLAY_TRACE_VERSION 1
+#define REPLAY_MAX_PKTLEN 1500
+
+typedef struct replay_record {
+  uint8_t type;
+  ngtcp2_tstamp ts;
+  const uint8_t *body;
+  size_t bodylen;
+} replay_record;
+
+typedef struct replay_addr {
+  struct sockaddr_storage ss;
+  ngtcp2_socklen len;
+} replay_addr;
+
+typedef struct replay_trace {
+  uint8_t *data;
+  replay_record *records;
+  size_t nrecords;
+  /* The following fields are taken from REPLAY_TRACE_START. */
+  int server;
+  ngtcp2_cc_algo cc_algo;
+  replay_addr local;
+  replay_addr remote;
+  ngtcp2_transport_params params;
+  const uint8_t *snapshot;
+  size_t snapshotlen;
+} replay_trace;
+
+typedef struct replay_result {
+  /* ns is the time spent in the library while replaying. */
+  uint64_t ns;
+  /* recv_ns is the time spent in ngtcp2_conn_read_pkts. */
+  uint64_t recv_ns;
+  /* ndgram is the number of REPLAY_TRACE_RECV records processed. */
+  uint64_t ndgram;
+  /* nbytes is the number of bytes received. */
+  uint64_t nbytes;
+  /* npkt is the number of packets written. */
+  uint64_t npkt;
+  /* nping is the number of packets written with
+     ngtcp2_conn_write_keep_alive because the connection had nothing
+     to send. */
+  uint64_t nping;
+  /* stopped is the index of the record which the connection failed
+     to process, or -1. */
+  int64_t stopped;
+  int stopped_rv;
+} replay_result;
+
+static uint64_t replay_rand_state;
+
+static uint64_t timestamp_ns(void) {
+  struct timespec tp;
+
+  clock_gettime(CLOCK_MONOTONIC, &tp);
+
+  return (uint64_t)tp.tv_sec * 1000000000 + (uint64_t)tp.tv_nsec;
+}
+
+static void check(int rv, const char *what) {
+  if (rv != 0) {
+    fprintf(stderr, "bench_replay: %s failed: %d\n", what, rv);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void die(const char *msg) {
+  fprintf(stderr, "bench_replay: %s\n", msg);
+  exit(EXIT_FAILURE);
+}
+
+static uint32_t get_uint32(const uint8_t *p) {
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+         p[3];
+}
+
+static uint64_t get_uint64(const uint8_t *p) {
+  return (uint64_t)get_uint32(p) << 32 | get_uint32(p + 4);
+}
+
+/*
+ * get_addr reads an address from |*pp| into |addr|, and advances
+ * |*pp|.  It returns -1 if the input is malformed.
+ */
+static int get_addr(replay_addr *addr, const uint8_t **pp,
+                    const uint8_t *end) {
+  const uint8_t *p = *pp;
+  size_t len;
+
+  if (p == end) {
+    return -1;
+  }
+
+  len = *p++;
+  if (len > sizeof(addr->ss) || (size_t)(end - p) < len) {
+    return -1;
+  }
+
+  memset(&addr->ss, 0, sizeof(addr->ss));
+  memcpy(&addr->ss, p, len);
+  addr->len = (ngtcp2_socklen)len;
+
+  *pp = p + len;
+
+  return 0;
+}
+
+static void conn_rand(uint8_t *dest, size_t destlen,
+                      const ngtcp2_rand_ctx *rand_ctx) {
+  size_t i;
+  (void)rand_ctx;
+
+  for (i = 0; i < destlen; ++i) {
+    replay_rand_state = replay_rand_state * 6364136223846793005ULL + 1;
+    dest[i] = (uint8_t)(replay_rand_state >> 56);
+  }
+}
+
+static int conn_client_initial(ngtcp2_conn *conn, void *user_data) {
+  (void)conn;
+  (void)user_data;
+
+  return 0;
+}
+
+static int conn_recv_client_initial(ngtcp2_conn *conn, const ngtcp2_cid *dcid,
+                                    void *user_data) {
+  (void)conn;
+  (void)dcid;
+  (void)user_data;
+
+  return 0;
+}
+
+static int conn_recv_crypto_data(ngtcp2_conn *conn,
+                                 ngtcp2_crypto_level crypto_level,
+                                 uint64_t offset, const uint8_t *data,
+                                 size_t datalen, void *user_data) {
+  (void)conn;
+  (void)crypto_level;
+  (void)offset;
+  (void)data;
+  (void)datalen;
+  (void)user_data;
+
+  return 0;
+}
+
+static int conn_recv_retry(ngtcp2_conn *conn, const ngtcp2_pkt_hd *hd,
+                           void *user_data) {
+  (void)conn;
+  (void)hd;
+  (void)user_data;
+
+  return 0;
+}
+
+static int conn_get_new_connection_id(ngtcp2_conn *conn, ngtcp2_cid *cid,
+                                      uint8_t *token, size_t cidlen,
+                                      void *user_data) {
+  (void)conn;
+  (void)user_data;
+
+  conn_rand(cid->data, cidlen, NULL);
+  cid->datalen = cidlen;
+  conn_rand(token, NGTCP2_STATELESS_RESET_TOKENLEN, NULL);
+
+  return 0;
+}
+
+/*
+ * conn_recv_stream_data consumes the received data immediately as
+ * the example server does.
+ */
+static int conn_recv_stream_data(ngtcp2_conn *conn, uint32_t flags,
+                                 int64_t stream_id, uint64_t offset,
+                                 const uint8_t *data, size_t datalen,
+                                 void *user_data, void *stream_user_data) {
+  (void)flags;
+  (void)offset;
+  (void)data;
+  (void)user_data;
+  (void)stream_user_data;
+
+  ngtcp2_conn_extend_max_stream_offset(conn, stream_id, datalen);
+  ngtcp2_conn_extend_max_offset(conn, datalen);
+
+  return 0;
+}
+
+static int conn_stream_close(ngtcp2_conn *conn, uint32_t flags,
+                             int64_t stream_id, uint64_t app_error_code,
+                             void *user_data, void *stream_user_data) {
+  (void)flags;
+  (void)app_error_code;
+  (void)user_data;
+  (void)stream_user_data;
+
+  if (ngtcp2_is_bidi_stream(stream_id)) {
+    ngtcp2_conn_extend_max_streams_bidi(conn, 1);
+  } else {
+    ngtcp2_conn_extend_max_streams_uni(conn, 1);
+  }
+
+  return 0;
+}
+
+/*
+ * trace_load reads the trace in |path| into |trace|.
+ */
+static void trace_load(replay_trace *trace, const char *path) {
+  FILE *fp;
+  long size;
+  const uint8_t *p, *end;
+  size_t n, cap = 0;
+  replay_record *rec;
+  int rv;
+
+  memset(trace, 0, sizeof(*trace));
+
+  fp = fopen(path, "rb");
+  if (fp == NULL) {
+    perror("bench_replay: fopen");
+    exit(EXIT_FAILURE);
+  }
+
+  if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 ||
+      fseek(fp, 0, SEEK_SET) != 0) {
+    die("could not get the size of the trace");
+  }
+
+  trace->data = malloc((size_t)size + 1);
+  if (trace->data == NULL) {
+    die("out of memory");
+  }
+
+  if (fread(trace->data, 1, (size_t)size, fp) != (size_t)size) {
+    die("could not read the trace");
+  }
+
+  fclose(fp);
+
+  p = trace->data;
+  end = p + size;
+
+  if (size < 5 || memcmp(p, "NGPT", 4) != 0 || p[4] != REPLAY_TRACE_VERSION) {
+    die("not a packet trace");
+  }
+
+  p += 5;
+
+  /* A record which is cut off at the end of the trace is ignored,
+     because the server might have been killed while writing it. */
+  while ((size_t)(end - p) >= 1 + 8 + 4) {
+    n = get_uint32(p + 1 + 8);
+    if ((size_t)(end - p) - (1 + 8 + 4) < n) {
+      break;
+    }
+
+    if (trace->nrecords == cap) {
+      cap = cap ? cap * 2 : 1024;
+      trace->records = realloc(trace->records, sizeof(replay_record) * cap);
+      if (trace->records == NULL) {
+        die("out of memory");
+      }
+    }
+
+    rec = &trace->records[trace->nrecords++];
+    rec->type = p[0];
+    rec->ts = get_uint64(p + 1);
+    rec->body = p + 1 + 8 + 4;
+    rec->bodylen = n;
+
+    p += 1 + 8 + 4 + n;
+  }
+
+  if (trace->nrecords == 0 || trace->records[0].type != REPLAY_TRACE_START) {
+    die("the trace does not start with a snapshot");
+  }
+
+  rec = &trace->records[0];
+  p = rec->body;
+  end = p + rec->bodylen;
+
+  if ((size_t)(end - p) < 3) {
+    die("malformed start record");
+  }
+
+  trace->server = p[0];
+  trace->cc_algo = (ngtcp2_cc_algo)p[1];
+  n = p[2];
+  p += 3;
+
+  if ((size_t)(end - p) < n) {
+    die("malformed start record");
+  }
+
+  /* The cipher suite name differs between TLS stacks. */
+  if (!(n == sizeof("TLS_AES_128_GCM_SHA256") - 1 &&
+        memcmp(p, "TLS_AES_128_GCM_SHA256", n) == 0) &&
+      !(n == sizeof("AES-128-GCM") - 1 && memcmp(p, "AES-128-GCM", n) == 0)) {
+    fprintf(stderr, "bench_replay: unsupported cipher suite %.*s\n", (int)n,
+            p);
+    exit(EXIT_FAILURE);
+  }
+
+  p += n;
+
+  if (get_addr(&trace->local, &p, end) != 0 ||
+      get_addr(&trace->remote, &p, end) != 0 || (size_t)(end - p) < 4) {
+    die("malformed start record");
+  }
+
+  n = get_uint32(p);
+  p += 4;
+
+  if ((size_t)(end - p) < n) {
+    die("malformed start record");
+  }
+
+  rv = ngtcp2_decode_transport_params(
+      &trace->params,
+      trace->server ? NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS
+                    : NGTCP2_TRANSPORT_PARAMS_TYPE_CLIENT_HELLO,
+      p, n);
+  check(rv, "ngtcp2_decode_transport_params");
+
+  p += n;
+
+  trace->snapshot = p;
+  trace->snapshotlen = (size_t)(end - p);
+}
+
+static void trace_free(replay_trace *trace) {
+  free(trace->records);
+  free(trace->data);
+}
+
+/*
+ * install_key installs 1-RTT keys derived from |rx_secret| and
+ * |tx_secret| to |conn|.
+ */
+static void install_key(ngtcp2_conn *conn, const ngtcp2_vec *rx_secret,
+                        const ngtcp2_vec *tx_secret) {
+  const ngtcp2_crypto_ctx *ctx = ngtcp2_conn_get_crypto_ctx(conn);
+  ngtcp2_crypto_aead_ctx aead_ctx = {0};
+  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
+  uint8_t key[16], iv[NGTCP2_CRYPTO_INITIAL_IVLEN], hp_key[16];
+
+  check(ngtcp2_crypto_derive_packet_protection_key(
+            key, iv, hp_key, ngtcp2_conn_get_negotiated_version(conn),
+            &ctx->aead, &ctx->md, rx_secret->base, rx_secret->len),
+        "ngtcp2_crypto_derive_packet_protection_key");
+  check(ngtcp2_crypto_aead_ctx_decrypt_init(&aead_ctx, &ctx->aead, key,
+                                            sizeof(iv)),
+        "ngtcp2_crypto_aead_ctx_decrypt_init");
+  check(ngtcp2_crypto_cipher_ctx_encrypt_init(&hp_ctx, &ctx->hp, hp_key),
+        "ngtcp2_crypto_cipher_ctx_encrypt_init");
+  check(ngtcp2_conn_install_rx_key(conn, rx_secret->base, rx_secret->len,
+                                   &aead_ctx, iv, sizeof(iv), &hp_ctx),
+        "ngtcp2_conn_install_rx_key");
+
+  check(ngtcp2_crypto_derive_packet_protection_key(
+            key, iv, hp_key, ngtcp2_conn_get_negotiated_version(conn),
+            &ctx->aead, &ctx->md, tx_secret->base, tx_secret->len),
+        "ngtcp2_crypto_derive_packet_protection_key");
+  check(ngtcp2_crypto_aead_ctx_encrypt_init(&aead_ctx, &ctx->aead, key,
+                                            sizeof(iv)),
+        "ngtcp2_crypto_aead_ctx_encrypt_init");
+  check(ngtcp2_crypto_cipher_ctx_encrypt_init(&hp_ctx, &ctx->hp, hp_key),
+        "ngtcp2_crypto_cipher_ctx_encrypt_init");
+  check(ngtcp2_conn_install_tx_key(conn, tx_secret->base, tx_secret->len,
+                                   &aead_ctx, iv, sizeof(iv), &hp_ctx),
+        "ngtcp2_conn_install_tx_key");
+}
+
+/*
+ * conn_restore creates a connection from the snapshot in |trace|.
+ */
+static ngtcp2_conn *conn_restore(const replay_trace *trace,
+                                 ngtcp2_path_storage *ps) {
+  ngtcp2_conn *conn;
+  ngtcp2_callbacks cb;
+  ngtcp2_settings settings;
+  ngtcp2_crypto_ctx ctx;
+  ngtcp2_cid dcid, scid;
+  ngtcp2_vec rx_secret, tx_secret;
+  ngtcp2_tstamp ts = trace->records[0].ts;
+
+  memset(&cb, 0, sizeof(cb));
+  cb.client_initial = conn_client_initial;
+  cb.recv_client_initial = conn_recv_client_initial;
+  cb.recv_crypto_data = conn_recv_crypto_data;
+  cb.recv_retry = conn_recv_retry;
+  cb.encrypt = ngtcp2_crypto_encrypt_cb;
+  cb.decrypt = ngtcp2_crypto_decrypt_cb;
+  cb.hp_mask = ngtcp2_crypto_hp_mask_cb;
+  cb.rand = conn_rand;
+  cb.get_new_connection_id = conn_get_new_connection_id;
+  cb.update_key = ngtcp2_crypto_update_key_cb;
+  cb.delete_crypto_aead_ctx = ngtcp2_crypto_delete_crypto_aead_ctx_cb;
+  cb.delete_crypto_cipher_ctx = ngtcp2_crypto_delete_crypto_cipher_ctx_cb;
+  cb.get_path_challenge_data = ngtcp2_crypto_get_path_challenge_data_cb;
+  cb.recv_stream_data = conn_recv_stream_data;
+  cb.stream_close = conn_stream_close;
+
+  ngtcp2_settings_default(&settings);
+  settings.initial_ts = ts;
+  settings.cc_algo = trace->cc_algo;
+
+  /* The connection IDs are replaced with the ones in the snapshot. */
+  conn_rand(dcid.data, NGTCP2_MIN_INITIAL_DCIDLEN, NULL);
+  dcid.datalen = NGTCP2_MIN_INITIAL_DCIDLEN;
+  conn_rand(scid.data, NGTCP2_MIN_INITIAL_DCIDLEN, NULL);
+  scid.datalen = NGTCP2_MIN_INITIAL_DCIDLEN;
+
+  ngtcp2_path_storage_init(ps, (const ngtcp2_sockaddr *)&trace->local.ss,
+                           trace->local.len,
+                           (const ngtcp2_sockaddr *)&trace->remote.ss,
+                           trace->remote.len, NULL);
+
+  if (trace->server) {
+    check(ngtcp2_conn_server_new(&conn, &dcid, &scid, &ps->path,
+                                 NGTCP2_PROTO_VER_V1, &cb, &settings,
+                                 &trace->params, NULL, NULL),
+          "ngtcp2_conn_server_new");
+  } else {
+    check(ngtcp2_conn_client_new(&conn, &dcid, &scid, &ps->path,
+                                 NGTCP2_PROTO_VER_V1, &cb, &settings,
+                                 &trace->params, NULL, NULL),
+          "ngtcp2_conn_client_new");
+  }
+
+  ngtcp2_crypto_ctx_cipher_suite(&ctx, NGTCP2_CRYPTO_TLS_AES_128_GCM_SHA256);
+  ngtcp2_conn_set_crypto_ctx(conn, &ctx);
+
+  check(ngtcp2_conn_decode_and_set_snapshot(conn, &rx_secret, &tx_secret,
+                                            trace->snapshot,
+                                            trace->snapshotlen, ts),
+        "ngtcp2_conn_decode_and_set_snapshot");
+
+  install_key(conn, &rx_secret, &tx_secret);
+
+  return conn;
+}
+
+/*
+ * replay_recv feeds the datagrams in |rec| to |conn|.
+ */
+static int replay_recv(ngtcp2_conn *conn, const replay_record *rec,
+                       replay_result *res) {
+  const uint8_t *p = rec->body, *end = p + rec->bodylen;
+  ngtcp2_pkt_info pi = {0};
+  replay_addr local, remote;
+  ngtcp2_path path;
+  size_t gso_size;
+  uint64_t start;
+  int rv;
+
+  if ((size_t)(end - p) < 1 + 4) {
+    die("malformed recv record");
+  }
+
+  pi.ecn = p[0];
+  gso_size = get_uint32(p + 1);
+  p += 1 + 4;
+
+  if (get_addr(&local, &p, end) != 0 || get_addr(&remote, &p, end) != 0) {
+    die("malformed recv record");
+  }
+
+  path.local.addr = (ngtcp2_sockaddr *)&local.ss;
+  path.local.addrlen = local.len;
+  path.remote.addr = (ngtcp2_sockaddr *)&remote.ss;
+  path.remote.addrlen = remote.len;
+  path.user_data = NULL;
+
+  if (gso_size == 0) {
+    gso_size = (size_t)(end - p);
+  }
+
+  start = timestamp_ns();
+  rv = ngtcp2_conn_read_pkts(conn, &path, &pi, p, (size_t)(end - p), gso_size,
+                             rec->ts);
+  res->recv_ns += timestamp_ns() - start;
+
+  ++res->ndgram;
+  res->nbytes += (uint64_t)(end - p);
+
+  return rv;
+}
+
+/*
+ * replay_send writes a packet for the packet which the original
+ * connection wrote.
+ */
+static int replay_send(ngtcp2_conn *conn, const replay_record *rec,
+                       replay_result *res) {
+  uint8_t buf[REPLAY_MAX_PKTLEN];
+  size_t pktlen;
+  ngtcp2_ssize nwrite;
+
+  if (rec->bodylen < 4) {
+    die("malformed send record");
+  }
+
+  pktlen = get_uint32(rec->body);
+  if (pktlen > sizeof(buf)) {
+    pktlen = sizeof(buf);
+  }
+
+  nwrite = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, pktlen, rec->ts);
+  if (nwrite < 0) {
+    return (int)nwrite;
+  }
+
+  if (nwrite == 0) {
+    nwrite = ngtcp2_conn_write_keep_alive(conn, NULL, NULL, buf, sizeof(buf),
+                                          rec->ts);
+    if (nwrite < 0) {
+      return (int)nwrite;
+    }
+
+    ++res->nping;
+  }
+
+  ngtcp2_conn_update_pkt_tx_time(conn, rec->ts);
+
+  ++res->npkt;
+
+  return 0;
+}
+
+static void replay_run(replay_result *res, const replay_trace *trace) {
+  ngtcp2_conn *conn;
+  ngtcp2_path_storage ps;
+  const replay_record *rec;
+  uint64_t start;
+  size_t i;
+  int rv = 0;
+
+  memset(res, 0, sizeof(*res));
+  res->stopped = -1;
+
+  replay_rand_state = 0;
+
+  conn = conn_restore(trace, &ps);
+
+  start = timestamp_ns();
+
+  for (i = 1; i < trace->nrecords; ++i) {
+    rec = &trace->records[i];
+
+    switch (rec->type) {
+    case REPLAY_TRACE_RECV:
+      rv = replay_recv(conn, rec, res);
+      break;
+    case REPLAY_TRACE_SEND:
+      rv = replay_send(conn, rec, res);
+      break;
+    case REPLAY_TRACE_EXPIRY:
+      rv = ngtcp2_conn_handle_expiry(conn, rec->ts);
+      break;
+    default:
+      /* Unknown records are skipped. */
+      continue;
+    }
+
+    if (rv != 0) {
+      res->stopped = (int64_t)i;
+      res->stopped_rv = rv;
+      break;
+    }
+  }
+
+  res->ns = timestamp_ns() - start;
+
+  ngtcp2_conn_del(conn);
+}
+
+static void print_usage(void) {
+  printf("Usage: bench_replay [OPTIONS] TRACE\n"
+         "Replay TRACE recorded by server --trace-dir against a fresh\n"
+         "connection.  The result is written to stdout in JSON.\n"
+         "Options:\n"
+         "  -r, --rounds=<N>  The number of times the trace is replayed.\n"
+         "                    Default: 5\n"
+         "  -h, --help        Display this help and exit.\n");
+}
+
+int main(int argc, char **argv) {
+  size_t rounds = 5;
+  replay_trace trace;
+  replay_result res, best;
+  uint64_t sum = 0;
+  size_t r;
+
+  for (;;) {
+    static struct option long_opts[] = {
+        {"rounds", required_argument, NULL, 'r'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int optidx = 0;
+    int c = getopt_long(argc, argv, "r:h", long_opts, &optidx);
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case 'r':
+      rounds = (size_t)strtoul(optarg, NULL, 10);
+      if (rounds == 0) {
+        fprintf(stderr, "bench_replay: rounds must be positive\n");
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'h':
+      print_usage();
+      return EXIT_SUCCESS;
+    default:
+      print_usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind + 1 != argc) {
+    print_usage();
+    return EXIT_FAILURE;
+  }
+
+#ifdef NGTCP2_BENCH_CRYPTO_OPENSSL
+  check(ngtcp2_crypto_openssl_init(), "ngtcp2_crypto_openssl_init");
+#endif /* NGTCP2_BENCH_CRYPTO_OPENSSL */
+
+  trace_load(&trace, argv[optind]);
+
+  memset(&best, 0, sizeof(best));
+  best.ns = UINT64_MAX;
+
+  for (r = 0; r < rounds; ++r) {
+    replay_run(&res, &trace);
+    if (res.ns < best.ns) {
+      best = res;
+    }
+    sum += res.ns;
+  }
+
+  printf("{\n"
+         "  \"version\": \"%s\",\n"
+         "  \"backend\": \"%s\",\n"
+         "  \"rounds\": %zu,\n"
+         "  \"trace\": \"%s\",\n"
+         "  \"records\": %zu,\n"
+         "  \"datagrams\": %" PRIu64 ",\n"
+         "  \"bytes\": %" PRIu64 ",\n"
+         "  \"pkts_sent\": %" PRIu64 ",\n"
+         "  \"pings_sent\": %" PRIu64 ",\n"
+         "  \"best_ns\": %" PRIu64 ",\n"
+         "  \"mean_ns\": %" PRIu64 ",\n"
+         "  \"recv_ns\": %" PRIu64 ",\n"
+         "  \"ns_per_datagram\": %.2f,\n"
+         "  \"stopped_at\": %" PRId64 ",\n"
+         "  \"stopped_error\": \"%s\"\n"
+         "}\n",
+         ngtcp2_version(0)->version_str, NGTCP2_BENCH_CRYPTO_BACKEND, rounds,
+         argv[optind], trace.nrecords, best.ndgram, best.nbytes, best.npkt,
+         best.nping, best.ns, sum / rounds, best.recv_ns,
+         best.ndgram ? (double)best.recv_ns / (double)best.ndgram : 0.,
+         best.stopped,
+         best.stopped == -1 ? "" : ngtcp2_strerror(best.stopped_rv));
+
+  trace_free(&trace);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <linux/udp.h>
+#include <linux/bpf.h>
+
+#include <bpf/bpf_helpers.h>
+
+/*
+ * This eBPF program is attached to the SO_REUSEPORT group of the
+ * example server running in multi-worker mode.  It steers an incoming
+ * QUIC packet to the worker which owns the connection.  The worker
+ * index is encoded in the first byte of every Connection ID that a
+ * worker generates, and a worker which accepts a new connection is
+ * chosen by the first byte of Destination Connection ID that a
+ * client chooses.  That way, all packets of a connection, including
+ * the ones sent after connection migration, arrive at the same worker.
+ */
+
+/* reuseport_array maps worker index to its socket. */
+struct {
+  __uint(type, BPF_MAP_TYPE_REUSEPORT_SOCKARRAY);
+  __uint(max_entries, 255);
+  __type(key, __u32);
+  __type(value, __u64);
+} reuseport_array SEC(".maps");
+
+/* worker_info contains the number of workers at index 0. */
+struct {
+  __uint(type, BPF_MAP_TYPE_ARRAY);
+  __uint(max_entries, 1);
+  __type(key, __u32);
+  __type(value, __u32);
+} worker_info SEC(".maps");
+
+/* QUIC_HEADER_FORM_BIT is the Header Form bit in the first byte of
+   QUIC packet. */
+#define QUIC_HEADER_FORM_BIT 0x80
+
+/* QUIC_LONG_DCIDLEN_OFFSET is the offset to Destination Connection ID
+   Length field in long header packet. */
+#define QUIC_LONG_DCIDLEN_OFFSET 5
+
+/* QUIC_HDLEN is the number of bytes which this program reads from
+   QUIC packet: the first byte, Version, DCID Length, and the first
+   byte of DCID in long header packet. */
+#define QUIC_HDLEN 7
+
+SEC("sk_reuseport")
+int select_reuseport(struct sk_reuseport_md *reuse_md) {
+  __u8 hd[QUIC_HDLEN];
+  __u32 zero = 0, key;
+  __u32 *pnum_workers;
+  __u8 cid_byte;
+
+  pnum_workers = bpf_map_lookup_elem(&worker_info, &zero);
+  if (!pnum_workers || *pnum_workers == 0) {
+    return SK_PASS;
+  }
+
+  if (bpf_skb_load_bytes(reuse_md, sizeof(struct udphdr), hd, sizeof(hd)) !=
+      0) {
+    return SK_PASS;
+  }
+
+  if (hd[0] & QUIC_HEADER_FORM_BIT) {
+    if (hd[QUIC_LONG_DCIDLEN_OFFSET] == 0) {
+      return SK_PASS;
+    }
+
+    cid_byte = hd[QUIC_LONG_DCIDLEN_OFFSET + 1];
+  } else {
+    cid_byte = hd[1];
+  }
+
+  key = cid_byte % *pnum_workers;
+
+  /* If the selected socket is not available, fall back to the kernel
+     default hashing. */
+  bpf_sk_select_reuseport(reuse_md, &reuseport_array, &key, 0);
+
+  return SK_PASS;
+}
+
+char _license[] SEC("license") = "MIT";
@@ -0,0 +1,115 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/in.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/udp.h>
+
+#include <bpf/bpf_endian.h>
+#include <bpf/bpf_helpers.h>
+
+/*
+ * This XDP program is attached to the network interface that the
+ * example server serves with --xdp.  It redirects the UDP datagrams
+ * destined to the QUIC port to the AF_XDP socket bound to the
+ * receive queue, and passes everything else, including IP fragments
+ * and IPv6 packets with extension headers, to the kernel network
+ * stack.
+ */
+
+/* xsks_map maps receive queue index to AF_XDP socket. */
+struct {
+  __uint(type, BPF_MAP_TYPE_XSKMAP);
+  __uint(max_entries, 64);
+  __type(key, __u32);
+  __type(value, __u32);
+} xsks_map SEC(".maps");
+
+/* quic_port contains the UDP port in host byte order at index 0. */
+struct {
+  __uint(type, BPF_MAP_TYPE_ARRAY);
+  __uint(max_entries, 1);
+  __type(key, __u32);
+  __type(value, __u32);
+} quic_port SEC(".maps");
+
+/* IPV4_FRAG_MASK is the mask of More Fragments flag and Fragment
+   Offset field in IPv4 header. */
+#define IPV4_FRAG_MASK 0x3fff
+
+SEC("xdp")
+int redirect_quic(struct xdp_md *ctx) {
+  void *data = (void *)(long)ctx->data;
+  void *data_end = (void *)(long)ctx->data_end;
+  struct ethhdr *eth = data;
+  struct iphdr *iph;
+  struct ipv6hdr *ip6h;
+  struct udphdr *udph;
+  __u32 zero = 0;
+  __u32 *pport;
+
+  if ((void *)(eth + 1) > data_end) {
+    return XDP_PASS;
+  }
+
+  switch (bpf_ntohs(eth->h_proto)) {
+  case ETH_P_IP:
+    iph = (void *)(eth + 1);
+    if ((void *)(iph + 1) > data_end || iph->protocol != IPPROTO_UDP ||
+        (bpf_ntohs(iph->frag_off) & IPV4_FRAG_MASK)) {
+      return XDP_PASS;
+    }
+
+    udph = (void *)iph + iph->ihl * 4;
+
+    break;
+  case ETH_P_IPV6:
+    ip6h = (void *)(eth + 1);
+    if ((void *)(ip6h + 1) > data_end || ip6h->nexthdr != IPPROTO_UDP) {
+      return XDP_PASS;
+    }
+
+    udph = (void *)(ip6h + 1);
+
+    break;
+  default:
+    return XDP_PASS;
+  }
+
+  if ((void *)(udph + 1) > data_end) {
+    return XDP_PASS;
+  }
+
+  pport = bpf_map_lookup_elem(&quic_port, &zero);
+  if (!pport || bpf_ntohs(udph->dest) != *pport) {
+    return XDP_PASS;
+  }
+
+  return bpf_redirect_map(&xsks_map, ctx->rx_queue_index, XDP_PASS);
+}
+
+char _license[] SEC("license") = "MIT";
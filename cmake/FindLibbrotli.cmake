@@ -0,0 +1,43 @@
+# - Try to find libbrotli
+# Once done this will define
+#  LIBBROTLI_FOUND        - System has libbrotlienc and libbrotlidec
+#  LIBBROTLI_INCLUDE_DIRS - The libbrotli include directories
+#  LIBBROTLI_LIBRARIES    - The libraries needed to use libbrotli
+
+find_package(PkgConfig QUIET)
+pkg_check_modules(PC_LIBBROTLIENC QUIET libbrotlienc)
+pkg_check_modules(PC_LIBBROTLIDEC QUIET libbrotlidec)
+
+find_path(LIBBROTLI_INCLUDE_DIR
+  NAMES brotli/encode.h brotli/decode.h
+  HINTS ${PC_LIBBROTLIENC_INCLUDE_DIRS} ${PC_LIBBROTLIDEC_INCLUDE_DIRS}
+)
+find_library(LIBBROTLIENC_LIBRARY
+  NAMES brotlienc
+  HINTS ${PC_LIBBROTLIENC_LIBRARY_DIRS}
+)
+find_library(LIBBROTLIDEC_LIBRARY
+  NAMES brotlidec
+  HINTS ${PC_LIBBROTLIDEC_LIBRARY_DIRS}
+)
+
+if(PC_LIBBROTLIENC_FOUND)
+  set(LIBBROTLI_VERSION ${PC_LIBBROTLIENC_VERSION})
+endif()
+
+include(FindPackageHandleStandardArgs)
+# handle the QUIETLY and REQUIRED arguments and set LIBBROTLI_FOUND
+# to TRUE if all listed variables are TRUE and the requested version
+# matches.
+find_package_handle_standard_args(Libbrotli REQUIRED_VARS
+                                  LIBBROTLIENC_LIBRARY LIBBROTLIDEC_LIBRARY
+                                  LIBBROTLI_INCLUDE_DIR
+                                  VERSION_VAR LIBBROTLI_VERSION)
+
+if(LIBBROTLI_FOUND)
+  set(LIBBROTLI_LIBRARIES    ${LIBBROTLIENC_LIBRARY} ${LIBBROTLIDEC_LIBRARY})
+  set(LIBBROTLI_INCLUDE_DIRS ${LIBBROTLI_INCLUDE_DIR})
+endif()
+
+mark_as_advanced(LIBBROTLI_INCLUDE_DIR LIBBROTLIENC_LIBRARY
+                 LIBBROTLIDEC_LIBRARY)
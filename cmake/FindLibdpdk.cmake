@@ -0,0 +1,42 @@
+# - Try to find libdpdk
+# Once done this will define
+#  LIBDPDK_FOUND        - System has libdpdk
+#  LIBDPDK_INCLUDE_DIRS - The libdpdk include directories
+#  LIBDPDK_LIBRARIES    - The libraries needed to use libdpdk
+#  LIBDPDK_CFLAGS_OTHER - The compiler flags needed to use libdpdk
+
+find_package(PkgConfig QUIET)
+pkg_check_modules(PC_LIBDPDK QUIET libdpdk)
+
+find_path(LIBDPDK_INCLUDE_DIR
+  NAMES rte_ethdev.h
+  HINTS ${PC_LIBDPDK_INCLUDE_DIRS}
+  PATH_SUFFIXES dpdk
+)
+# DPDK consists of many libraries, and its drivers must be linked
+# with the flags which pkg-config gives.  rte_ethdev is looked up only
+# to confirm that DPDK is installed.
+find_library(LIBDPDK_LIBRARY
+  NAMES rte_ethdev
+  HINTS ${PC_LIBDPDK_LIBRARY_DIRS}
+)
+
+if(PC_LIBDPDK_FOUND)
+  set(LIBDPDK_VERSION ${PC_LIBDPDK_VERSION})
+endif()
+
+include(FindPackageHandleStandardArgs)
+# handle the QUIETLY and REQUIRED arguments and set LIBDPDK_FOUND
+# to TRUE if all listed variables are TRUE and the requested version
+# matches.
+find_package_handle_standard_args(Libdpdk REQUIRED_VARS
+                                  LIBDPDK_LIBRARY LIBDPDK_INCLUDE_DIR
+                                  VERSION_VAR LIBDPDK_VERSION)
+
+if(LIBDPDK_FOUND)
+  set(LIBDPDK_LIBRARIES     ${PC_LIBDPDK_LINK_LIBRARIES})
+  set(LIBDPDK_INCLUDE_DIRS  ${PC_LIBDPDK_INCLUDE_DIRS})
+  set(LIBDPDK_CFLAGS_OTHER  ${PC_LIBDPDK_CFLAGS_OTHER})
+endif()
+
+mark_as_advanced(LIBDPDK_INCLUDE_DIR LIBDPDK_LIBRARY)
@@ -0,0 +1,36 @@
+# - Try to find liburing
+# Once done this will define
+#  LIBURING_FOUND        - System has liburing
+#  LIBURING_INCLUDE_DIRS - The liburing include directories
+#  LIBURING_LIBRARIES    - The libraries needed to use liburing
+
+find_package(PkgConfig QUIET)
+pkg_check_modules(PC_LIBURING QUIET liburing)
+
+find_path(LIBURING_INCLUDE_DIR
+  NAMES liburing.h
+  HINTS ${PC_LIBURING_INCLUDE_DIRS}
+)
+find_library(LIBURING_LIBRARY
+  NAMES uring
+  HINTS ${PC_LIBURING_LIBRARY_DIRS}
+)
+
+if(PC_LIBURING_FOUND)
+  set(LIBURING_VERSION ${PC_LIBURING_VERSION})
+endif()
+
+include(FindPackageHandleStandardArgs)
+# handle the QUIETLY and REQUIRED arguments and set LIBURING_FOUND
+# to TRUE if all listed variables are TRUE and the requested version
+# matches.
+find_package_handle_standard_args(Liburing REQUIRED_VARS
+                                  LIBURING_LIBRARY LIBURING_INCLUDE_DIR
+                                  VERSION_VAR LIBURING_VERSION)
+
+if(LIBURING_FOUND)
+  set(LIBURING_LIBRARIES     ${LIBURING_LIBRARY})
+  set(LIBURING_INCLUDE_DIRS  ${LIBURING_INCLUDE_DIR})
+endif()
+
+mark_as_advanced(LIBURING_INCLUDE_DIR LIBURING_LIBRARY)
@@ -92,8 +92,8 @@ ngtcp2_crypto_aead *ngtcp2_crypto_aead_retry(ngtcp2_crypto_aead *aead) {
   return ngtcp2_crypto_aead_init(aead, (void *)EVP_aead_aes_128_gcm());
 }
 
-static const EVP_AEAD *crypto_ssl_get_aead(SSL *ssl) {
-  switch (SSL_CIPHER_get_id(SSL_get_current_cipher(ssl))) {
+static const EVP_AEAD *crypto_get_aead(uint32_t cipher_id) {
+  switch (cipher_id) {
   case TLS1_CK_AES_128_GCM_SHA256:
     return EVP_aead_aes_128_gcm();
   case TLS1_CK_AES_256_GCM_SHA384:
@@ -105,8 +105,8 @@ static const EVP_AEAD *crypto_ssl_get_aead(SSL *ssl) {
   }
 }
 
-static uint64_t crypto_ssl_get_aead_max_encryption(SSL *ssl) {
-  switch (SSL_CIPHER_get_id(SSL_get_current_cipher(ssl))) {
+static uint64_t crypto_get_aead_max_encryption(uint32_t cipher_id) {
+  switch (cipher_id) {
   case TLS1_CK_AES_128_GCM_SHA256:
   case TLS1_CK_AES_256_GCM_SHA384:
     return NGTCP2_CRYPTO_MAX_ENCRYPTION_AES_GCM;
@@ -117,8 +117,8 @@ static uint64_t crypto_ssl_get_aead_max_encryption(SSL *ssl) {
   }
 }
 
-static uint64_t crypto_ssl_get_aead_max_decryption_failure(SSL *ssl) {
-  switch (SSL_CIPHER_get_id(SSL_get_current_cipher(ssl))) {
+static uint64_t crypto_get_aead_max_decryption_failure(uint32_t cipher_id) {
+  switch (cipher_id) {
   case TLS1_CK_AES_128_GCM_SHA256:
   case TLS1_CK_AES_256_GCM_SHA384:
     return NGTCP2_CRYPTO_MAX_DECRYPTION_FAILURE_AES_GCM;
@@ -129,8 +129,9 @@ static uint64_t crypto_ssl_get_aead_max_decryption_failure(SSL *ssl) {
   }
 }
 
-static const ngtcp2_crypto_boringssl_cipher *crypto_ssl_get_hp(SSL *ssl) {
-  switch (SSL_CIPHER_get_id(SSL_get_current_cipher(ssl))) {
+static const ngtcp2_crypto_boringssl_cipher *
+crypto_get_hp(uint32_t cipher_id) {
+  switch (cipher_id) {
   case TLS1_CK_AES_128_GCM_SHA256:
     return &crypto_cipher_aes_128;
   case TLS1_CK_AES_256_GCM_SHA384:
@@ -142,8 +143,8 @@ static const ngtcp2_crypto_boringssl_cipher *crypto_ssl_get_hp(SSL *ssl) {
   }
 }
 
-static const EVP_MD *crypto_ssl_get_md(SSL *ssl) {
-  switch (SSL_CIPHER_get_id(SSL_get_current_cipher(ssl))) {
+static const EVP_MD *crypto_get_md(uint32_t cipher_id) {
+  switch (cipher_id) {
   case TLS1_CK_AES_128_GCM_SHA256:
   case TLS1_CK_CHACHA20_POLY1305_SHA256:
     return EVP_sha256();
@@ -154,14 +155,33 @@ static const EVP_MD *crypto_ssl_get_md(SSL *ssl) {
   }
 }
 
+static void crypto_ctx_init(ngtcp2_crypto_ctx *ctx, uint32_t cipher_id) {
+  ngtcp2_crypto_aead_init(&ctx->aead, (void *)crypto_get_aead(cipher_id));
+  ctx->md.native_handle = (void *)crypto_get_md(cipher_id);
+  ctx->hp.native_handle = (void *)crypto_get_hp(cipher_id);
+  ctx->max_encryption = crypto_get_aead_max_encryption(cipher_id);
+  ctx->max_decryption_failure =
+      crypto_get_aead_max_decryption_failure(cipher_id);
+}
+
 ngtcp2_crypto_ctx *ngtcp2_crypto_ctx_tls(ngtcp2_crypto_ctx *ctx,
                                          void *tls_native_handle) {
   SSL *ssl = tls_native_handle;
-  ngtcp2_crypto_aead_init(&ctx->aead, (void *)crypto_ssl_get_aead(ssl));
-  ctx->md.native_handle = (void *)crypto_ssl_get_md(ssl);
-  ctx->hp.native_handle = (void *)crypto_ssl_get_hp(ssl);
-  ctx->max_encryption = crypto_ssl_get_aead_max_encryption(ssl);
-  ctx->max_decryption_failure = crypto_ssl_get_aead_max_decryption_failure(ssl);
+  crypto_ctx_init(ctx, SSL_CIPHER_get_id(SSL_get_current_cipher(ssl)));
+  return ctx;
+}
+
+ngtcp2_crypto_ctx *ngtcp2_crypto_ctx_cipher_suite(ngtcp2_crypto_ctx *ctx,
+                                                  uint16_t cipher_suite) {
+  /* The ID of TLSv1.3 cipher suite is 0x0300 followed by the 2 bytes
+     cipher suite. */
+  uint32_t cipher_id = 0x03000000u | cipher_suite;
+
+  if (!crypto_get_aead(cipher_id)) {
+    return NULL;
+  }
+
+  crypto_ctx_init(ctx, cipher_id);
   return ctx;
 }
 
@@ -219,6 +239,45 @@ int ngtcp2_crypto_aead_ctx_decrypt_init(ngtcp2_crypto_aead_ctx *aead_ctx,
   return ngtcp2_crypto_aead_ctx_encrypt_init(aead_ctx, aead, key, noncelen);
 }
 
+int ngtcp2_crypto_aead_ctx_encrypt_reinit(ngtcp2_crypto_aead_ctx *aead_ctx,
+                                          const ngtcp2_crypto_aead *aead,
+                                          const uint8_t *key,
+                                          size_t noncelen) {
+  const EVP_AEAD *cipher = aead->native_handle;
+  size_t keylen = crypto_aead_keylen(cipher);
+  EVP_AEAD_CTX *actx = aead_ctx->native_handle;
+
+  (void)noncelen;
+
+  /* EVP_AEAD_CTX holds its state inline.  Reset it in place instead
+     of allocating a new one. */
+  if (EVP_AEAD_CTX_aead(actx) != cipher) {
+    EVP_AEAD_CTX_free(actx);
+    aead_ctx->native_handle = NULL;
+    return -1;
+  }
+
+  EVP_AEAD_CTX_cleanup(actx);
+
+  if (!EVP_AEAD_CTX_init(actx, cipher, key, keylen,
+                         EVP_AEAD_DEFAULT_TAG_LENGTH, NULL)) {
+    /* EVP_AEAD_CTX_init leaves actx in a state that can be freed on
+       failure. */
+    EVP_AEAD_CTX_free(actx);
+    aead_ctx->native_handle = NULL;
+    return -1;
+  }
+
+  return 0;
+}
+
+int ngtcp2_crypto_aead_ctx_decrypt_reinit(ngtcp2_crypto_aead_ctx *aead_ctx,
+                                          const ngtcp2_crypto_aead *aead,
+                                          const uint8_t *key,
+                                          size_t noncelen) {
+  return ngtcp2_crypto_aead_ctx_encrypt_reinit(aead_ctx, aead, key, noncelen);
+}
+
 void ngtcp2_crypto_aead_ctx_free(ngtcp2_crypto_aead_ctx *aead_ctx) {
   if (aead_ctx->native_handle) {
     EVP_AEAD_CTX_free(aead_ctx->native_handle);
@@ -328,11 +387,60 @@ int ngtcp2_crypto_encrypt(uint8_t *dest, const ngtcp2_crypto_aead *aead,
                           const uint8_t *aad, size_t aadlen) {
   const EVP_AEAD *cipher = aead->native_handle;
   EVP_AEAD_CTX *actx = aead_ctx->native_handle;
-  size_t max_outlen = plaintextlen + EVP_AEAD_max_overhead(cipher);
-  size_t outlen;
+  size_t taglen;
+
+  /* Write the tag directly after the ciphertext.  Unlike
+     EVP_AEAD_CTX_seal, this does not have to account for the whole
+     output buffer, and allows |dest| == |plaintext|. */
+  if (EVP_AEAD_CTX_seal_scatter(actx, dest, dest + plaintextlen, &taglen,
+                                EVP_AEAD_max_overhead(cipher), nonce,
+                                noncelen, plaintext, plaintextlen, NULL, 0,
+                                aad, aadlen) != 1) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int ngtcp2_crypto_encrypt_vec(uint8_t *dest, const ngtcp2_crypto_aead *aead,
+                              const ngtcp2_crypto_aead_ctx *aead_ctx,
+                              const ngtcp2_vec *plaintext, size_t plaintextcnt,
+                              const uint8_t *nonce, size_t noncelen,
+                              const uint8_t *aad, size_t aadlen) {
+  const EVP_AEAD *cipher = aead->native_handle;
+  EVP_AEAD_CTX *actx = aead_ctx->native_handle;
+  const ngtcp2_vec *extra;
+  uint8_t *p = dest;
+  size_t i, taglen;
+
+  if (plaintextcnt == 0) {
+    return ngtcp2_crypto_encrypt(dest, aead, aead_ctx, dest, 0, nonce,
+                                 noncelen, aad, aadlen);
+  }
+
+  for (i = 0; i + 1 < plaintextcnt; ++i) {
+    if (plaintext[i].base != p) {
+      memcpy(p, plaintext[i].base, plaintext[i].len);
+    }
+
+    p += plaintext[i].len;
+  }
+
+  extra = &plaintext[plaintextcnt - 1];
+
+  if (extra->base == p) {
+    return ngtcp2_crypto_encrypt(dest, aead, aead_ctx, dest,
+                                 (size_t)(p - dest) + extra->len, nonce,
+                                 noncelen, aad, aadlen);
+  }
 
-  if (EVP_AEAD_CTX_seal(actx, dest, &outlen, max_outlen, nonce, noncelen,
-                        plaintext, plaintextlen, aad, aadlen) != 1) {
+  /* EVP_AEAD is one-shot, but the last vector can be encrypted from
+     its original location as extra input.  Its ciphertext is written
+     just before the tag. */
+  if (EVP_AEAD_CTX_seal_scatter(
+          actx, dest, p, &taglen, extra->len + EVP_AEAD_max_overhead(cipher),
+          nonce, noncelen, dest, (size_t)(p - dest), extra->base, extra->len,
+          aad, aadlen) != 1) {
     return -1;
   }
 
@@ -347,17 +455,17 @@ int ngtcp2_crypto_decrypt(uint8_t *dest, const ngtcp2_crypto_aead *aead,
   const EVP_AEAD *cipher = aead->native_handle;
   EVP_AEAD_CTX *actx = aead_ctx->native_handle;
   size_t max_overhead = EVP_AEAD_max_overhead(cipher);
-  size_t max_outlen;
-  size_t outlen;
+  size_t payloadlen;
 
   if (ciphertextlen < max_overhead) {
     return -1;
   }
 
-  max_outlen = ciphertextlen - max_overhead;
+  payloadlen = ciphertextlen - max_overhead;
 
-  if (EVP_AEAD_CTX_open(actx, dest, &outlen, max_outlen, nonce, noncelen,
-                        ciphertext, ciphertextlen, aad, aadlen) != 1) {
+  if (EVP_AEAD_CTX_open_gather(actx, dest, nonce, noncelen, ciphertext,
+                               payloadlen, ciphertext + payloadlen,
+                               max_overhead, aad, aadlen) != 1) {
     return -1;
   }
 
@@ -401,7 +509,11 @@ int ngtcp2_crypto_read_write_crypto_data(ngtcp2_conn *conn,
   int rv;
   int err;
 
-  if (SSL_provide_quic_data(
+  /* datalen == 0 may resume the handshake suspended by a private key
+     operation.  Do not provide data, which could be rejected at a
+     lower encryption level than the current one. */
+  if (datalen &&
+      SSL_provide_quic_data(
           ssl, ngtcp2_crypto_boringssl_from_ngtcp2_crypto_level(crypto_level),
           data, datalen) != 1) {
     return -1;
@@ -416,6 +528,8 @@ int ngtcp2_crypto_read_write_crypto_data(ngtcp2_conn *conn,
       case SSL_ERROR_WANT_READ:
       case SSL_ERROR_WANT_WRITE:
         return 0;
+      case SSL_ERROR_WANT_PRIVATE_KEY_OPERATION:
+        return NGTCP2_CRYPTO_BORINGSSL_ERR_TLS_WANT_PRIVATE_KEY_OPERATION;
       case SSL_ERROR_SSL:
         return -1;
       case SSL_ERROR_EARLY_DATA_REJECTED:
@@ -27,6 +27,7 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <assert.h>
+#include <stdlib.h>
 
 #include <ngtcp2/ngtcp2_crypto.h>
 #include <ngtcp2/ngtcp2_crypto_gnutls.h>
@@ -171,6 +172,41 @@ ngtcp2_crypto_ctx *ngtcp2_crypto_ctx_tls_early(ngtcp2_crypto_ctx *ctx,
   return ctx;
 }
 
+ngtcp2_crypto_ctx *ngtcp2_crypto_ctx_cipher_suite(ngtcp2_crypto_ctx *ctx,
+                                                  uint16_t cipher_suite) {
+  gnutls_cipher_algorithm_t cipher;
+  gnutls_digest_algorithm_t hash;
+
+  switch (cipher_suite) {
+  case NGTCP2_CRYPTO_TLS_AES_128_GCM_SHA256:
+    cipher = GNUTLS_CIPHER_AES_128_GCM;
+    hash = GNUTLS_DIG_SHA256;
+    break;
+  case NGTCP2_CRYPTO_TLS_AES_256_GCM_SHA384:
+    cipher = GNUTLS_CIPHER_AES_256_GCM;
+    hash = GNUTLS_DIG_SHA384;
+    break;
+  case NGTCP2_CRYPTO_TLS_CHACHA20_POLY1305_SHA256:
+    cipher = GNUTLS_CIPHER_CHACHA20_POLY1305;
+    hash = GNUTLS_DIG_SHA256;
+    break;
+  case NGTCP2_CRYPTO_TLS_AES_128_CCM_SHA256:
+    cipher = GNUTLS_CIPHER_AES_128_CCM;
+    hash = GNUTLS_DIG_SHA256;
+    break;
+  default:
+    return NULL;
+  }
+
+  ngtcp2_crypto_aead_init(&ctx->aead, (void *)cipher);
+  ctx->md.native_handle = (void *)hash;
+  ctx->hp.native_handle = (void *)crypto_get_hp(cipher);
+  ctx->max_encryption = crypto_get_aead_max_encryption(cipher);
+  ctx->max_decryption_failure = crypto_get_aead_max_decryption_failure(cipher);
+
+  return ctx;
+}
+
 size_t ngtcp2_crypto_md_hashlen(const ngtcp2_crypto_md *md) {
   return gnutls_hash_get_len(
       (gnutls_digest_algorithm_t)(intptr_t)md->native_handle);
@@ -230,35 +266,111 @@ int ngtcp2_crypto_aead_ctx_decrypt_init(ngtcp2_crypto_aead_ctx *aead_ctx,
   return 0;
 }
 
+/*
+ * crypto_aead_ctx_reinit sets |key| to the existing
+ * gnutls_aead_cipher_hd_t of |aead_ctx|.  gnutls_aead_cipher_set_key
+ * is available since GnuTLS 3.7.5.  With the older versions, the
+ * handle is initialized again.
+ */
+static int crypto_aead_ctx_reinit(ngtcp2_crypto_aead_ctx *aead_ctx,
+                                  const ngtcp2_crypto_aead *aead,
+                                  const uint8_t *key, size_t noncelen) {
+#if GNUTLS_VERSION_NUMBER >= 0x030705
+  gnutls_datum_t _key;
+
+  (void)noncelen;
+
+  _key.data = (void *)key;
+  _key.size = (unsigned int)ngtcp2_crypto_aead_keylen(aead);
+
+  if (gnutls_aead_cipher_set_key(aead_ctx->native_handle, &_key) != 0) {
+    gnutls_aead_cipher_deinit(aead_ctx->native_handle);
+    aead_ctx->native_handle = NULL;
+    return -1;
+  }
+
+  return 0;
+#else  /* !(GNUTLS_VERSION_NUMBER >= 0x030705) */
+  gnutls_aead_cipher_deinit(aead_ctx->native_handle);
+  aead_ctx->native_handle = NULL;
+
+  /* gnutls_aead_cipher_hd_t is not bound to the direction. */
+  return ngtcp2_crypto_aead_ctx_encrypt_init(aead_ctx, aead, key, noncelen);
+#endif /* !(GNUTLS_VERSION_NUMBER >= 0x030705) */
+}
+
+int ngtcp2_crypto_aead_ctx_encrypt_reinit(ngtcp2_crypto_aead_ctx *aead_ctx,
+                                          const ngtcp2_crypto_aead *aead,
+                                          const uint8_t *key,
+                                          size_t noncelen) {
+  return crypto_aead_ctx_reinit(aead_ctx, aead, key, noncelen);
+}
+
+int ngtcp2_crypto_aead_ctx_decrypt_reinit(ngtcp2_crypto_aead_ctx *aead_ctx,
+                                          const ngtcp2_crypto_aead *aead,
+                                          const uint8_t *key,
+                                          size_t noncelen) {
+  return crypto_aead_ctx_reinit(aead_ctx, aead, key, noncelen);
+}
+
 void ngtcp2_crypto_aead_ctx_free(ngtcp2_crypto_aead_ctx *aead_ctx) {
   if (aead_ctx->native_handle) {
     gnutls_aead_cipher_deinit(aead_ctx->native_handle);
   }
 }
 
+typedef struct ngtcp2_crypto_gnutls_cipher_ctx {
+  gnutls_cipher_hd_t hd;
+  /* cbc_iv is the IV of the next AES-CBC block, that is the last
+     ciphertext block that hd produced.  Header protection needs
+     AES-ECB, and it is emulated by XORing the sample with cbc_iv so
+     that hd is used without resetting its IV per packet. */
+  uint8_t cbc_iv[16];
+} ngtcp2_crypto_gnutls_cipher_ctx;
+
 int ngtcp2_crypto_cipher_ctx_encrypt_init(ngtcp2_crypto_cipher_ctx *cipher_ctx,
                                           const ngtcp2_crypto_cipher *cipher,
                                           const uint8_t *key) {
   gnutls_cipher_algorithm_t _cipher =
       (gnutls_cipher_algorithm_t)(intptr_t)cipher->native_handle;
-  gnutls_cipher_hd_t hd;
+  ngtcp2_crypto_gnutls_cipher_ctx *ctx;
   gnutls_datum_t _key;
 
+  ctx = malloc(sizeof(*ctx));
+  if (ctx == NULL) {
+    return -1;
+  }
+
   _key.data = (void *)key;
   _key.size = (unsigned int)gnutls_cipher_get_key_size(_cipher);
 
-  if (gnutls_cipher_init(&hd, _cipher, &_key, NULL) != 0) {
+  if (gnutls_cipher_init(&ctx->hd, _cipher, &_key, NULL) != 0) {
+    free(ctx);
     return -1;
   }
 
-  cipher_ctx->native_handle = hd;
+  memset(ctx->cbc_iv, 0, sizeof(ctx->cbc_iv));
+
+  switch (_cipher) {
+  case GNUTLS_CIPHER_AES_128_CBC:
+  case GNUTLS_CIPHER_AES_256_CBC:
+    gnutls_cipher_set_iv(ctx->hd, ctx->cbc_iv, sizeof(ctx->cbc_iv));
+    break;
+  default:
+    break;
+  }
+
+  cipher_ctx->native_handle = ctx;
 
   return 0;
 }
 
 void ngtcp2_crypto_cipher_ctx_free(ngtcp2_crypto_cipher_ctx *cipher_ctx) {
-  if (cipher_ctx->native_handle) {
-    gnutls_cipher_deinit(cipher_ctx->native_handle);
+  ngtcp2_crypto_gnutls_cipher_ctx *ctx = cipher_ctx->native_handle;
+
+  if (ctx) {
+    gnutls_cipher_deinit(ctx->hd);
+    free(ctx);
   }
 }
 
@@ -339,6 +451,44 @@ int ngtcp2_crypto_encrypt(uint8_t *dest, const ngtcp2_crypto_aead *aead,
   return 0;
 }
 
+int ngtcp2_crypto_encrypt_vec(uint8_t *dest, const ngtcp2_crypto_aead *aead,
+                              const ngtcp2_crypto_aead_ctx *aead_ctx,
+                              const ngtcp2_vec *plaintext, size_t plaintextcnt,
+                              const uint8_t *nonce, size_t noncelen,
+                              const uint8_t *aad, size_t aadlen) {
+  gnutls_cipher_algorithm_t cipher =
+      (gnutls_cipher_algorithm_t)(intptr_t)aead->native_handle;
+  gnutls_aead_cipher_hd_t hd = aead_ctx->native_handle;
+  size_t taglen = gnutls_cipher_get_tag_size(cipher);
+  size_t ciphertextlen = taglen;
+  giovec_t iov[64];
+  giovec_t auth_iov;
+  size_t i;
+
+  if (plaintextcnt > sizeof(iov) / sizeof(iov[0])) {
+    return ngtcp2_crypto_encrypt_vec_gather(dest, aead, aead_ctx, plaintext,
+                                            plaintextcnt, nonce, noncelen, aad,
+                                            aadlen);
+  }
+
+  for (i = 0; i < plaintextcnt; ++i) {
+    iov[i].iov_base = plaintext[i].base;
+    iov[i].iov_len = plaintext[i].len;
+    ciphertextlen += plaintext[i].len;
+  }
+
+  auth_iov.iov_base = (void *)aad;
+  auth_iov.iov_len = aadlen;
+
+  if (gnutls_aead_cipher_encryptv(hd, nonce, noncelen, &auth_iov, 1, taglen,
+                                  iov, (int)plaintextcnt, dest,
+                                  &ciphertextlen) != 0) {
+    return -1;
+  }
+
+  return 0;
+}
+
 int ngtcp2_crypto_decrypt(uint8_t *dest, const ngtcp2_crypto_aead *aead,
                           const ngtcp2_crypto_aead_ctx *aead_ctx,
                           const uint8_t *ciphertext, size_t ciphertextlen,
@@ -370,24 +520,27 @@ int ngtcp2_crypto_hp_mask(uint8_t *dest, const ngtcp2_crypto_cipher *hp,
                           const uint8_t *sample) {
   gnutls_cipher_algorithm_t cipher =
       (gnutls_cipher_algorithm_t)(intptr_t)hp->native_handle;
-  gnutls_cipher_hd_t hd = hp_ctx->native_handle;
+  ngtcp2_crypto_gnutls_cipher_ctx *ctx = hp_ctx->native_handle;
+  gnutls_cipher_hd_t hd = ctx->hd;
 
   switch (cipher) {
   case GNUTLS_CIPHER_AES_128_CBC:
   case GNUTLS_CIPHER_AES_256_CBC: {
-    uint8_t iv[16];
     uint8_t buf[16];
+    size_t i;
 
-    /* Emulate one block AES-ECB by invalidating the effect of IV */
-    memset(iv, 0, sizeof(iv));
-
-    gnutls_cipher_set_iv(hd, iv, sizeof(iv));
+    /* Emulate one block AES-ECB by cancelling the IV which is the
+       previous ciphertext block. */
+    for (i = 0; i < sizeof(buf); ++i) {
+      buf[i] = sample[i] ^ ctx->cbc_iv[i];
+    }
 
-    if (gnutls_cipher_encrypt2(hd, sample, 16, buf, sizeof(buf)) != 0) {
+    if (gnutls_cipher_encrypt2(hd, buf, sizeof(buf), ctx->cbc_iv,
+                               sizeof(ctx->cbc_iv)) != 0) {
       return -1;
     }
 
-    memcpy(dest, buf, 5);
+    memcpy(dest, ctx->cbc_iv, 5);
   } break;
 
   case GNUTLS_CIPHER_CHACHA20_32: {
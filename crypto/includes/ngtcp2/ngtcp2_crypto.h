@@ -90,6 +90,22 @@ NGTCP2_EXTERN ngtcp2_crypto_ctx *ngtcp2_crypto_ctx_tls(ngtcp2_crypto_ctx *ctx,
 NGTCP2_EXTERN ngtcp2_crypto_ctx *
 ngtcp2_crypto_ctx_tls_early(ngtcp2_crypto_ctx *ctx, void *tls_native_handle);
 
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_ctx_cipher_suite` initializes |ctx| for TLSv1.3
+ * cipher suite |cipher_suite| (e.g., 0x1301 for
+ * TLS_AES_128_GCM_SHA256) in the same way as `ngtcp2_crypto_ctx_tls`
+ * does for the TLS session which negotiated it.  This is used to
+ * restore the connection by `ngtcp2_conn_decode_and_set_snapshot`
+ * without a TLS session.
+ *
+ * This function returns |ctx| if it succeeds, or NULL if
+ * |cipher_suite| is not supported.
+ */
+NGTCP2_EXTERN ngtcp2_crypto_ctx *
+ngtcp2_crypto_ctx_cipher_suite(ngtcp2_crypto_ctx *ctx, uint16_t cipher_suite);
+
 /**
  * @function
  *
@@ -258,6 +274,65 @@ ngtcp2_crypto_encrypt_cb(uint8_t *dest, const ngtcp2_crypto_aead *aead,
                          const uint8_t *nonce, size_t noncelen,
                          const uint8_t *aad, size_t aadlen);
 
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_encrypt_vec` encrypts the concatenation of
+ * |plaintextcnt| vectors pointed by |plaintext|, and writes the
+ * ciphertext into the buffer pointed by |dest|.  The length of
+ * ciphertext is the sum of the length of vectors +
+ * :member:`aead->max_overhead <ngtcp2_crypto_aead.max_overhead>`
+ * bytes long.  |dest| must have enough capacity to store the
+ * ciphertext.  Each vector must either not overlap with |dest|, or be
+ * located in |dest| at the offset where its ciphertext is written.
+ * The vectors which do not overlap with |dest| are not altered.
+ *
+ * This function returns 0 if it succeeds, or -1.
+ */
+NGTCP2_EXTERN int ngtcp2_crypto_encrypt_vec(
+    uint8_t *dest, const ngtcp2_crypto_aead *aead,
+    const ngtcp2_crypto_aead_ctx *aead_ctx, const ngtcp2_vec *plaintext,
+    size_t plaintextcnt, const uint8_t *nonce, size_t noncelen,
+    const uint8_t *aad, size_t aadlen);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_encrypt_vec_cb` is a wrapper function around
+ * `ngtcp2_crypto_encrypt_vec`.  It can be directly passed to
+ * :member:`ngtcp2_callbacks.encrypt_vec` field.
+ *
+ * This function returns 0 if it succeeds, or
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`.
+ */
+NGTCP2_EXTERN int ngtcp2_crypto_encrypt_vec_cb(
+    uint8_t *dest, const ngtcp2_crypto_aead *aead,
+    const ngtcp2_crypto_aead_ctx *aead_ctx, const ngtcp2_vec *plaintext,
+    size_t plaintextcnt, const uint8_t *nonce, size_t noncelen,
+    const uint8_t *aad, size_t aadlen);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_encrypt_batch_cb` performs all encryptions described
+ * by |ops| of length |opslen| with `ngtcp2_crypto_encrypt`.  It can
+ * be directly passed to :member:`ngtcp2_callbacks.encrypt_batch`
+ * field.
+ *
+ * The backends do not provide the multi-buffer AEAD implementation
+ * yet, and this function encrypts packets one by one.  It still
+ * saves the per packet callback dispatch, and the application can
+ * replace it with the multi-buffer implementation without changing
+ * the way it writes packets.
+ *
+ * This function returns 0 if it succeeds, or
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`.
+ */
+NGTCP2_EXTERN int
+ngtcp2_crypto_encrypt_batch_cb(const ngtcp2_crypto_aead *aead,
+                               const ngtcp2_crypto_aead_ctx *aead_ctx,
+                               const ngtcp2_encrypt_op *ops, size_t opslen);
+
 /**
  * @function
  *
@@ -330,6 +405,27 @@ ngtcp2_crypto_hp_mask_cb(uint8_t *dest, const ngtcp2_crypto_cipher *hp,
                          const ngtcp2_crypto_cipher_ctx *hp_ctx,
                          const uint8_t *sample);
 
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_hp_mask_batch_cb` produces the mask for each of
+ * |samples| of length |nsamples| with `ngtcp2_crypto_hp_mask`.  It
+ * can be directly passed to :member:`ngtcp2_callbacks.hp_mask_batch`
+ * field.
+ *
+ * The backends currently produce masks one by one because their
+ * header protection cipher context is initialized per sample.  An
+ * application which has access to the multi-block cipher
+ * implementation can provide its own callback instead.
+ *
+ * This function returns 0 if it succeeds, or
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`.
+ */
+NGTCP2_EXTERN int ngtcp2_crypto_hp_mask_batch_cb(
+    uint8_t *dest, const ngtcp2_crypto_cipher *hp,
+    const ngtcp2_crypto_cipher_ctx *hp_ctx, const uint8_t *const *samples,
+    size_t nsamples);
+
 /**
  * @function
  *
@@ -364,12 +460,17 @@ ngtcp2_crypto_hp_mask_cb(uint8_t *dest, const ngtcp2_crypto_cipher *hp,
  * :enum:`ngtcp2_crypto_level.NGTCP2_CRYPTO_LEVEL_EARLY`) to get
  * :type:`ngtcp2_crypto_ctx`.
  *
- * If |conn| is initialized as client, and |level| is
- * :enum:`ngtcp2_crypto_level.NGTCP2_CRYPTO_LEVEL_APPLICATION`, this
- * function retrieves a remote QUIC transport parameters extension
- * from an object obtained by `ngtcp2_conn_get_tls_native_handle` and
- * sets it to |conn| by calling
- * `ngtcp2_conn_decode_remote_transport_params`.
+ * If |conn| is initialized as client, |level| is
+ * :enum:`ngtcp2_crypto_level.NGTCP2_CRYPTO_LEVEL_APPLICATION`, and
+ * the handshake has not completed, this function retrieves a remote
+ * QUIC transport parameters extension from an object obtained by
+ * `ngtcp2_conn_get_tls_native_handle` and sets it to |conn| by
+ * calling `ngtcp2_conn_decode_remote_transport_params`.
+ *
+ * If :type:`ngtcp2_crypto_ctx` has already been set by
+ * `ngtcp2_conn_set_crypto_ctx`, the 1RTT keys are installed without
+ * accessing the TLS session.  This is how the keys of the connection
+ * restored by `ngtcp2_conn_decode_and_set_snapshot` are installed.
  *
  * This function returns 0 if it succeeds, or -1.
  */
@@ -418,12 +519,46 @@ NGTCP2_EXTERN int ngtcp2_crypto_derive_and_install_rx_key(
  * sets it to |conn| by calling
  * `ngtcp2_conn_decode_remote_transport_params`.
  *
+ * If :type:`ngtcp2_crypto_ctx` has already been set by
+ * `ngtcp2_conn_set_crypto_ctx`, the 1RTT keys are installed without
+ * accessing the TLS session.  This is how the keys of the connection
+ * restored by `ngtcp2_conn_decode_and_set_snapshot` are installed.
+ *
  * This function returns 0 if it succeeds, or -1.
  */
 NGTCP2_EXTERN int ngtcp2_crypto_derive_and_install_tx_key(
     ngtcp2_conn *conn, uint8_t *key, uint8_t *iv, uint8_t *hp,
     ngtcp2_crypto_level level, const uint8_t *secret, size_t secretlen);
 
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_derive_offload_key` derives the 1RTT packet
+ * protection key and IV for encryption from |secret| of length
+ * |secretlen| which is passed to
+ * :member:`ngtcp2_callbacks.offload_tx_key`, so that they can be
+ * installed into a NIC or a kernel which protects the packets on
+ * transmit.  The key is written to the buffer pointed by |key|, and
+ * the IV is written to the buffer pointed by |iv|.  If |hp| is not
+ * NULL, the header protection key is written to the buffer pointed
+ * by |hp|.  The header protection key must only be derived from the
+ * secret of the key ID 0.
+ *
+ * The length of packet protection key and header protection key is
+ * `ngtcp2_crypto_aead_keylen(ctx->aead) <ngtcp2_crypto_aead_keylen>`,
+ * and the length of packet protection IV is
+ * `ngtcp2_crypto_packet_protection_ivlen(ctx->aead)
+ * <ngtcp2_crypto_packet_protection_ivlen>` where ctx is obtained by
+ * `ngtcp2_conn_get_crypto_ctx`.
+ *
+ * This function returns 0 if it succeeds, or -1.
+ */
+NGTCP2_EXTERN int ngtcp2_crypto_derive_offload_key(ngtcp2_conn *conn,
+                                                   uint8_t *key, uint8_t *iv,
+                                                   uint8_t *hp,
+                                                   const uint8_t *secret,
+                                                   size_t secretlen);
+
 /**
  * @function
  *
@@ -484,6 +619,139 @@ NGTCP2_EXTERN int ngtcp2_crypto_update_key_cb(
     const uint8_t *current_rx_secret, const uint8_t *current_tx_secret,
     size_t secretlen, void *user_data);
 
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_CRYPTO_AEAD_CTX_POOL_SIZE` is the number of AEAD
+ * contexts that :type:`ngtcp2_crypto_aead_ctx_pool` tracks.
+ */
+#define NGTCP2_CRYPTO_AEAD_CTX_POOL_SIZE 8
+
+/**
+ * @struct
+ *
+ * :type:`ngtcp2_crypto_aead_ctx_pool_entry` is an AEAD context
+ * object that :type:`ngtcp2_crypto_aead_ctx_pool` created.
+ */
+typedef struct ngtcp2_crypto_aead_ctx_pool_entry {
+  /**
+   * :member:`native_handle` is the native handle of the AEAD context
+   * object.  NULL means that this entry is unused.
+   */
+  void *native_handle;
+  /**
+   * :member:`aead` is the native handle of
+   * :type:`ngtcp2_crypto_aead` that the context object was
+   * initialized with.
+   */
+  const void *aead;
+  /**
+   * :member:`encrypt` is nonzero if the context object is for
+   * encryption.
+   */
+  uint8_t encrypt;
+  /**
+   * :member:`in_use` is nonzero if the context object is currently
+   * handed out to the caller.
+   */
+  uint8_t in_use;
+} ngtcp2_crypto_aead_ctx_pool_entry;
+
+/**
+ * @struct
+ *
+ * :type:`ngtcp2_crypto_aead_ctx_pool` recycles the AEAD context
+ * objects of a connection across key updates.  A released context
+ * object is re-keyed for the next key phase instead of being freed
+ * and allocated again.  It is intended to be owned by a single
+ * connection, and it is not thread-safe.  Initialize it with
+ * `ngtcp2_crypto_aead_ctx_pool_init`, and free it with
+ * `ngtcp2_crypto_aead_ctx_pool_free` after the connection is
+ * deleted.
+ */
+typedef struct ngtcp2_crypto_aead_ctx_pool {
+  /**
+   * :member:`ents` is the tracked context objects.
+   */
+  ngtcp2_crypto_aead_ctx_pool_entry ents[NGTCP2_CRYPTO_AEAD_CTX_POOL_SIZE];
+} ngtcp2_crypto_aead_ctx_pool;
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_aead_ctx_pool_init` initializes |pool|.
+ */
+NGTCP2_EXTERN void
+ngtcp2_crypto_aead_ctx_pool_init(ngtcp2_crypto_aead_ctx_pool *pool);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_aead_ctx_pool_free` frees all context objects that
+ * |pool| holds.  The context objects that are still in use are not
+ * freed, and the caller must free them with
+ * `ngtcp2_crypto_aead_ctx_free`.
+ */
+NGTCP2_EXTERN void
+ngtcp2_crypto_aead_ctx_pool_free(ngtcp2_crypto_aead_ctx_pool *pool);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_aead_ctx_pool_encrypt_init` works like
+ * `ngtcp2_crypto_aead_ctx_encrypt_init`, but it re-keys a released
+ * context object in |pool| if there is one which was initialized
+ * with |aead| for encryption.
+ *
+ * This function returns 0 if it succeeds, or -1.
+ */
+NGTCP2_EXTERN int ngtcp2_crypto_aead_ctx_pool_encrypt_init(
+    ngtcp2_crypto_aead_ctx_pool *pool, ngtcp2_crypto_aead_ctx *aead_ctx,
+    const ngtcp2_crypto_aead *aead, const uint8_t *key, size_t noncelen);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_aead_ctx_pool_decrypt_init` works like
+ * `ngtcp2_crypto_aead_ctx_decrypt_init`, but it re-keys a released
+ * context object in |pool| if there is one which was initialized
+ * with |aead| for decryption.
+ *
+ * This function returns 0 if it succeeds, or -1.
+ */
+NGTCP2_EXTERN int ngtcp2_crypto_aead_ctx_pool_decrypt_init(
+    ngtcp2_crypto_aead_ctx_pool *pool, ngtcp2_crypto_aead_ctx *aead_ctx,
+    const ngtcp2_crypto_aead *aead, const uint8_t *key, size_t noncelen);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_aead_ctx_pool_release` returns |aead_ctx| to
+ * |pool|.  If |aead_ctx| was not created by |pool|, it is freed by
+ * `ngtcp2_crypto_aead_ctx_free`.  This function is intended to be
+ * called from :member:`ngtcp2_callbacks.delete_crypto_aead_ctx`.
+ */
+NGTCP2_EXTERN void
+ngtcp2_crypto_aead_ctx_pool_release(ngtcp2_crypto_aead_ctx_pool *pool,
+                                    ngtcp2_crypto_aead_ctx *aead_ctx);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_update_key_pooled` works like
+ * `ngtcp2_crypto_update_key`, but it obtains |rx_aead_ctx| and
+ * |tx_aead_ctx| from |pool|.  If |pool| is NULL, this function is
+ * equivalent to `ngtcp2_crypto_update_key`.
+ *
+ * This function returns 0 if it succeeds, or -1.
+ */
+NGTCP2_EXTERN int ngtcp2_crypto_update_key_pooled(
+    ngtcp2_conn *conn, uint8_t *rx_secret, uint8_t *tx_secret,
+    ngtcp2_crypto_aead_ctx *rx_aead_ctx, uint8_t *rx_key, uint8_t *rx_iv,
+    ngtcp2_crypto_aead_ctx *tx_aead_ctx, uint8_t *tx_key, uint8_t *tx_iv,
+    const uint8_t *current_rx_secret, const uint8_t *current_tx_secret,
+    size_t secretlen, ngtcp2_crypto_aead_ctx_pool *pool);
+
 /**
  * @function
  *
@@ -549,7 +817,17 @@ NGTCP2_EXTERN int ngtcp2_crypto_recv_client_initial_cb(ngtcp2_conn *conn,
  * The generic error code is -1 if a specific error code is not
  * suitable.  The error codes less than -10000 are specific to
  * underlying TLS implementation.  For OpenSSL, the error codes are
- * defined in *ngtcp2_crypto_openssl.h*.
+ * defined in *ngtcp2_crypto_openssl.h*.  For BoringSSL, they are
+ * defined in *ngtcp2_crypto_boringssl.h*.
+ *
+ * Some of the specific error codes indicate that the handshake is
+ * suspended by an asynchronous operation, such as offloaded private
+ * key signing.  In this case, the received data has been consumed,
+ * and the application resumes the handshake by calling this function
+ * with |datalen| == 0 after the operation completes.  An application
+ * which uses them has to provide its own
+ * :member:`ngtcp2_callbacks.recv_crypto_data` which returns 0 for
+ * them.
  */
 NGTCP2_EXTERN int
 ngtcp2_crypto_read_write_crypto_data(ngtcp2_conn *conn,
@@ -635,6 +913,24 @@ NGTCP2_EXTERN int ngtcp2_crypto_generate_stateless_reset_token(
   (/* magic = */ 1 + sizeof(ngtcp2_tstamp) + /* aead tag = */ 16 +             \
    NGTCP2_CRYPTO_TOKEN_RAND_DATALEN)
 
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_CRYPTO_MAX_REGULAR_TOKEN_DATALEN` is the maximum
+ * length of the opaque data that
+ * `ngtcp2_crypto_generate_regular_token2` embeds in a token.
+ */
+#define NGTCP2_CRYPTO_MAX_REGULAR_TOKEN_DATALEN 64
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_CRYPTO_MAX_REGULAR_TOKEN2LEN` is the maximum length
+ * of a token generated by `ngtcp2_crypto_generate_regular_token2`.
+ */
+#define NGTCP2_CRYPTO_MAX_REGULAR_TOKEN2LEN                                    \
+  (NGTCP2_CRYPTO_MAX_REGULAR_TOKENLEN + NGTCP2_CRYPTO_MAX_REGULAR_TOKEN_DATALEN)
+
 /**
  * @function
  *
@@ -722,6 +1018,405 @@ NGTCP2_EXTERN int ngtcp2_crypto_verify_regular_token(
     size_t secretlen, const ngtcp2_sockaddr *remote_addr,
     ngtcp2_socklen remote_addrlen, ngtcp2_duration timeout, ngtcp2_tstamp ts);
 
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_generate_regular_token2` is like
+ * `ngtcp2_crypto_generate_regular_token`, but it also encrypts the
+ * opaque |data| of length |datalen| into the token, so that server
+ * can get it back when client presents the token in a later
+ * connection.  A typical use is to carry the congestion control
+ * state encoded by `ngtcp2_encode_cc_resume_params`.  |datalen| must
+ * not exceed :macro:`NGTCP2_CRYPTO_MAX_REGULAR_TOKEN_DATALEN`.  The
+ * buffer pointed by |token| must have at least
+ * :macro:`NGTCP2_CRYPTO_MAX_REGULAR_TOKEN2LEN` bytes long.  If
+ * |datalen| is 0, the generated token is identical in format to the
+ * one generated by `ngtcp2_crypto_generate_regular_token`.
+ *
+ * This function returns the length of generated token if it succeeds,
+ * or -1.
+ */
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_crypto_generate_regular_token2(
+    uint8_t *token, const uint8_t *secret, size_t secretlen,
+    const ngtcp2_sockaddr *remote_addr, ngtcp2_socklen remote_addrlen,
+    const void *data, size_t datalen, ngtcp2_tstamp ts);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_verify_regular_token2` is like
+ * `ngtcp2_crypto_verify_regular_token`, but it accepts a token
+ * generated by `ngtcp2_crypto_generate_regular_token2`, and copies
+ * the opaque data embedded in it to the buffer pointed by |data| of
+ * length |max_datalen|.  It fails if the opaque data does not fit in
+ * the buffer.
+ *
+ * This function returns the length of the opaque data if it
+ * succeeds, or -1.
+ */
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_crypto_verify_regular_token2(
+    void *data, size_t max_datalen, const uint8_t *token, size_t tokenlen,
+    const uint8_t *secret, size_t secretlen,
+    const ngtcp2_sockaddr *remote_addr, ngtcp2_socklen remote_addrlen,
+    ngtcp2_duration timeout, ngtcp2_tstamp ts);
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_CRYPTO_TOKEN_IVLEN` is the length of IV to encrypt
+ * a token.
+ */
+#define NGTCP2_CRYPTO_TOKEN_IVLEN 12
+
+/**
+ * @struct
+ *
+ * :type:`ngtcp2_crypto_token_ctx` holds the keys to generate and
+ * verify Retry and regular tokens, which are derived from a secret
+ * only once.  The functions which take a secret, such as
+ * `ngtcp2_crypto_generate_retry_token`, derive a key for each token,
+ * which is expensive when server is flooded with Initial packets.
+ * The tokens generated with :type:`ngtcp2_crypto_token_ctx` can only
+ * be verified with :type:`ngtcp2_crypto_token_ctx` which is
+ * initialized with the same secret.  To rotate the secret, initialize
+ * a new object, and keep the previous one for as long as the tokens
+ * it generated are valid.  This object must not be shared between
+ * threads.
+ */
+typedef struct ngtcp2_crypto_token_ctx {
+  /**
+   * :member:`aead` is AEAD to encrypt tokens.
+   */
+  ngtcp2_crypto_aead aead;
+  /**
+   * :member:`retry_encrypt_ctx` is AEAD context to encrypt Retry
+   * tokens.
+   */
+  ngtcp2_crypto_aead_ctx retry_encrypt_ctx;
+  /**
+   * :member:`retry_decrypt_ctx` is AEAD context to decrypt Retry
+   * tokens.
+   */
+  ngtcp2_crypto_aead_ctx retry_decrypt_ctx;
+  /**
+   * :member:`regular_encrypt_ctx` is AEAD context to encrypt regular
+   * tokens.
+   */
+  ngtcp2_crypto_aead_ctx regular_encrypt_ctx;
+  /**
+   * :member:`regular_decrypt_ctx` is AEAD context to decrypt regular
+   * tokens.
+   */
+  ngtcp2_crypto_aead_ctx regular_decrypt_ctx;
+  /**
+   * :member:`retry_iv` is IV for Retry tokens.  It is XORed with the
+   * random data in a token to make a nonce.
+   */
+  uint8_t retry_iv[NGTCP2_CRYPTO_TOKEN_IVLEN];
+  /**
+   * :member:`regular_iv` is IV for regular tokens.  It is XORed with
+   * the random data in a token to make a nonce.
+   */
+  uint8_t regular_iv[NGTCP2_CRYPTO_TOKEN_IVLEN];
+} ngtcp2_crypto_token_ctx;
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_token_ctx_init` derives the keys from |secret| of
+ * length |secretlen|, and initializes |ctx| with them.  The caller
+ * must call `ngtcp2_crypto_token_ctx_free` when |ctx| is no longer
+ * used.
+ *
+ * This function returns 0 if it succeeds, or -1.
+ */
+NGTCP2_EXTERN int ngtcp2_crypto_token_ctx_init(ngtcp2_crypto_token_ctx *ctx,
+                                               const uint8_t *secret,
+                                               size_t secretlen);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_token_ctx_free` frees resources allocated for
+ * |ctx|.
+ */
+NGTCP2_EXTERN void ngtcp2_crypto_token_ctx_free(ngtcp2_crypto_token_ctx *ctx);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_token_ctx_generate_retry_token` is like
+ * `ngtcp2_crypto_generate_retry_token`, but it encrypts the token
+ * with the key in |ctx|.
+ *
+ * This function returns the length of generated token if it succeeds,
+ * or -1.
+ */
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_crypto_token_ctx_generate_retry_token(
+    ngtcp2_crypto_token_ctx *ctx, uint8_t *token, uint32_t version,
+    const ngtcp2_sockaddr *remote_addr, ngtcp2_socklen remote_addrlen,
+    const ngtcp2_cid *retry_scid, const ngtcp2_cid *odcid, ngtcp2_tstamp ts);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_token_ctx_verify_retry_token` is like
+ * `ngtcp2_crypto_verify_retry_token`, but it decrypts the token with
+ * the key in |ctx|.
+ *
+ * This function returns 0 if it succeeds, or -1.
+ */
+NGTCP2_EXTERN int ngtcp2_crypto_token_ctx_verify_retry_token(
+    ngtcp2_crypto_token_ctx *ctx, ngtcp2_cid *odcid, const uint8_t *token,
+    size_t tokenlen, uint32_t version, const ngtcp2_sockaddr *remote_addr,
+    ngtcp2_socklen remote_addrlen, const ngtcp2_cid *dcid,
+    ngtcp2_duration timeout, ngtcp2_tstamp ts);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_token_ctx_generate_regular_token` is like
+ * `ngtcp2_crypto_generate_regular_token`, but it encrypts the token
+ * with the key in |ctx|.
+ *
+ * This function returns the length of generated token if it succeeds,
+ * or -1.
+ */
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_crypto_token_ctx_generate_regular_token(
+    ngtcp2_crypto_token_ctx *ctx, uint8_t *token,
+    const ngtcp2_sockaddr *remote_addr, ngtcp2_socklen remote_addrlen,
+    ngtcp2_tstamp ts);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_token_ctx_verify_regular_token` is like
+ * `ngtcp2_crypto_verify_regular_token`, but it decrypts the token
+ * with the key in |ctx|.
+ *
+ * This function returns 0 if it succeeds, or -1.
+ */
+NGTCP2_EXTERN int ngtcp2_crypto_token_ctx_verify_regular_token(
+    ngtcp2_crypto_token_ctx *ctx, const uint8_t *token, size_t tokenlen,
+    const ngtcp2_sockaddr *remote_addr, ngtcp2_socklen remote_addrlen,
+    ngtcp2_duration timeout, ngtcp2_tstamp ts);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_token_ctx_generate_regular_token2` is like
+ * `ngtcp2_crypto_generate_regular_token2`, but it encrypts the token
+ * with the key in |ctx|.
+ *
+ * This function returns the length of generated token if it succeeds,
+ * or -1.
+ */
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_crypto_token_ctx_generate_regular_token2(
+    ngtcp2_crypto_token_ctx *ctx, uint8_t *token,
+    const ngtcp2_sockaddr *remote_addr, ngtcp2_socklen remote_addrlen,
+    const void *data, size_t datalen, ngtcp2_tstamp ts);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_token_ctx_verify_regular_token2` is like
+ * `ngtcp2_crypto_verify_regular_token2`, but it decrypts the token
+ * with the key in |ctx|.
+ *
+ * This function returns the length of the opaque data if it
+ * succeeds, or -1.
+ */
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_crypto_token_ctx_verify_regular_token2(
+    ngtcp2_crypto_token_ctx *ctx, void *data, size_t max_datalen,
+    const uint8_t *token, size_t tokenlen, const ngtcp2_sockaddr *remote_addr,
+    ngtcp2_socklen remote_addrlen, ngtcp2_duration timeout, ngtcp2_tstamp ts);
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_CRYPTO_MIN_ENCRYPTED_CIDLEN` is the minimum length
+ * of Connection ID that :type:`ngtcp2_crypto_cid_ctx` can encrypt.
+ */
+#define NGTCP2_CRYPTO_MIN_ENCRYPTED_CIDLEN 4
+
+/**
+ * @struct
+ *
+ * :type:`ngtcp2_crypto_cid_ctx` holds the key to encrypt and decrypt
+ * Connection IDs in the manner of QUIC-LB.  Server puts its server
+ * ID and a per-server counter in the plaintext, and encrypts it into
+ * a Connection ID.  Because the plaintext can be recovered from the
+ * Connection ID alone, and a Stateless Reset Token can be derived
+ * from the Connection ID with
+ * `ngtcp2_crypto_generate_stateless_reset_token`, server does not
+ * have to store anything per Connection ID.  The first octet of a
+ * Connection ID is not encrypted so that it can carry the routing
+ * and configuration bits.  The rest is encrypted with 4 rounds of
+ * Feistel network.  This object must not be shared between threads.
+ */
+typedef struct ngtcp2_crypto_cid_ctx {
+  /**
+   * :member:`aead` is AEAD which is used as the round function.
+   */
+  ngtcp2_crypto_aead aead;
+  /**
+   * :member:`aead_ctx` is AEAD context for the round function.
+   */
+  ngtcp2_crypto_aead_ctx aead_ctx;
+  /**
+   * :member:`iv` is IV which is XORed with the round input to make a
+   * nonce.
+   */
+  uint8_t iv[NGTCP2_CRYPTO_TOKEN_IVLEN];
+} ngtcp2_crypto_cid_ctx;
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_cid_ctx_init` derives the key from |secret| of
+ * length |secretlen|, and initializes |ctx| with it.  The caller must
+ * call `ngtcp2_crypto_cid_ctx_free` when |ctx| is no longer used.
+ *
+ * This function returns 0 if it succeeds, or -1.
+ */
+NGTCP2_EXTERN int ngtcp2_crypto_cid_ctx_init(ngtcp2_crypto_cid_ctx *ctx,
+                                             const uint8_t *secret,
+                                             size_t secretlen);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_cid_ctx_free` frees resources allocated for |ctx|.
+ */
+NGTCP2_EXTERN void ngtcp2_crypto_cid_ctx_free(ngtcp2_crypto_cid_ctx *ctx);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_cid_ctx_encrypt_cid` encrypts |plaintext| of length
+ * |plaintextlen| and stores the result in |cid|.  The first octet of
+ * |plaintext| is copied as is.  |plaintextlen| must be in the range
+ * [:macro:`NGTCP2_CRYPTO_MIN_ENCRYPTED_CIDLEN`,
+ * :macro:`NGTCP2_MAX_CIDLEN`], inclusive.  The length of |cid| is
+ * |plaintextlen|.
+ *
+ * This function returns 0 if it succeeds, or -1.
+ */
+NGTCP2_EXTERN int ngtcp2_crypto_cid_ctx_encrypt_cid(ngtcp2_crypto_cid_ctx *ctx,
+                                                    ngtcp2_cid *cid,
+                                                    const uint8_t *plaintext,
+                                                    size_t plaintextlen);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_cid_ctx_decrypt_cid` decrypts |cid| which was
+ * encrypted by `ngtcp2_crypto_cid_ctx_encrypt_cid`, and writes the
+ * plaintext to the buffer pointed by |plaintext|.  The buffer must
+ * have at least |cid|->datalen bytes.
+ *
+ * This function returns 0 if it succeeds, or -1.
+ */
+NGTCP2_EXTERN int ngtcp2_crypto_cid_ctx_decrypt_cid(ngtcp2_crypto_cid_ctx *ctx,
+                                                    uint8_t *plaintext,
+                                                    const ngtcp2_cid *cid);
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_CRYPTO_QUIC_LB_MAX_CONFIG_ID` is the maximum value
+ * of QUIC-LB config rotation ID.  The value 7 is reserved for
+ * Connection IDs which are not routable.
+ */
+#define NGTCP2_CRYPTO_QUIC_LB_MAX_CONFIG_ID 6
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_CRYPTO_QUIC_LB_MAX_SERVER_IDLEN` is the maximum
+ * length of QUIC-LB server ID.
+ */
+#define NGTCP2_CRYPTO_QUIC_LB_MAX_SERVER_IDLEN 15
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_CRYPTO_QUIC_LB_MIN_NONCELEN` is the minimum length
+ * of QUIC-LB nonce.
+ */
+#define NGTCP2_CRYPTO_QUIC_LB_MIN_NONCELEN 4
+
+/**
+ * @struct
+ *
+ * :type:`ngtcp2_crypto_quic_lb_config` is the QUIC-LB configuration
+ * shared by a server and the load balancers in front of it.  A
+ * Connection ID is laid out as the first octet, the server ID, and
+ * the nonce.  The first octet carries the config rotation ID in its
+ * 3 most significant bits, and the length of Connection ID minus 1
+ * in the rest.
+ */
+typedef struct ngtcp2_crypto_quic_lb_config {
+  /**
+   * :member:`config_id` is the config rotation ID.  It must not
+   * exceed :macro:`NGTCP2_CRYPTO_QUIC_LB_MAX_CONFIG_ID`.
+   */
+  uint8_t config_id;
+  /**
+   * :member:`server_id` is the server ID.
+   */
+  uint8_t server_id[NGTCP2_CRYPTO_QUIC_LB_MAX_SERVER_IDLEN];
+  /**
+   * :member:`server_idlen` is the length of server ID.  It must be at
+   * least 1.
+   */
+  size_t server_idlen;
+  /**
+   * :member:`noncelen` is the length of nonce.  It must be at least
+   * :macro:`NGTCP2_CRYPTO_QUIC_LB_MIN_NONCELEN`.  1 +
+   * :member:`server_idlen` + :member:`noncelen` must not exceed
+   * :macro:`NGTCP2_MAX_CIDLEN`.
+   */
+  size_t noncelen;
+  /**
+   * :member:`cid_ctx`, if not ``NULL``, encrypts the server ID and
+   * nonce.  If it is ``NULL``, they are sent in plaintext.
+   */
+  ngtcp2_crypto_cid_ctx *cid_ctx;
+} ngtcp2_crypto_quic_lb_config;
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_quic_lb_generate_cid` generates a Connection ID
+ * which encodes the server ID in |config| and |nonce|, and stores it
+ * in |cid|.  |nonce| must be :member:`config->noncelen
+ * <ngtcp2_crypto_quic_lb_config.noncelen>` bytes long.  It should be
+ * random in plaintext mode, and must not repeat under the same
+ * configuration in encrypted mode.
+ *
+ * This function returns 0 if it succeeds, or -1.
+ */
+NGTCP2_EXTERN int ngtcp2_crypto_quic_lb_generate_cid(
+    ngtcp2_cid *cid, const ngtcp2_crypto_quic_lb_config *config,
+    const uint8_t *nonce);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_quic_lb_decode_server_id` extracts the server ID
+ * from |cid| under |config|, and writes it to the buffer pointed by
+ * |server_id|.  The buffer must have at least
+ * :member:`config->server_idlen
+ * <ngtcp2_crypto_quic_lb_config.server_idlen>` bytes.
+ *
+ * This function returns 0 if it succeeds, or -1 if |cid| was not
+ * generated under |config|.
+ */
+NGTCP2_EXTERN int ngtcp2_crypto_quic_lb_decode_server_id(
+    uint8_t *server_id, const ngtcp2_crypto_quic_lb_config *config,
+    const ngtcp2_cid *cid);
+
 /**
  * @function
  *
@@ -746,6 +1441,90 @@ NGTCP2_EXTERN ngtcp2_ssize ngtcp2_crypto_write_connection_close(
     const ngtcp2_cid *scid, uint64_t error_code, const uint8_t *reason,
     size_t reasonlen);
 
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_CRYPTO_INITIAL_KEY_CACHE_SIZE` is the number of
+ * entries in :type:`ngtcp2_crypto_initial_key_cache`.
+ */
+#define NGTCP2_CRYPTO_INITIAL_KEY_CACHE_SIZE 16
+
+/**
+ * @struct
+ *
+ * :type:`ngtcp2_crypto_initial_key_cache_entry` is the Initial
+ * packet protection key that server derived for a client's
+ * Destination Connection ID.
+ */
+typedef struct ngtcp2_crypto_initial_key_cache_entry {
+  /**
+   * :member:`version` is the QUIC version.  0 means that this entry
+   * is unused.
+   */
+  uint32_t version;
+  /**
+   * :member:`dcid` is the Destination Connection ID in Initial packet
+   * from client.
+   */
+  ngtcp2_cid dcid;
+  /**
+   * :member:`tx_key` is the server's packet protection key.
+   */
+  uint8_t tx_key[NGTCP2_CRYPTO_INITIAL_KEYLEN];
+  /**
+   * :member:`tx_iv` is the server's packet protection IV.
+   */
+  uint8_t tx_iv[NGTCP2_CRYPTO_INITIAL_IVLEN];
+  /**
+   * :member:`tx_hp_key` is the server's header protection key.
+   */
+  uint8_t tx_hp_key[NGTCP2_CRYPTO_INITIAL_KEYLEN];
+} ngtcp2_crypto_initial_key_cache_entry;
+
+/**
+ * @struct
+ *
+ * :type:`ngtcp2_crypto_initial_key_cache` caches the Initial packet
+ * protection keys for the recently seen Destination Connection IDs,
+ * so that server does not run the key derivation again for the
+ * retransmitted Initial packets.  It is not thread-safe.  Initialize
+ * it with `ngtcp2_crypto_initial_key_cache_init`.
+ */
+typedef struct ngtcp2_crypto_initial_key_cache {
+  /**
+   * :member:`ents` is the cached entries.
+   */
+  ngtcp2_crypto_initial_key_cache_entry
+      ents[NGTCP2_CRYPTO_INITIAL_KEY_CACHE_SIZE];
+  /**
+   * :member:`next` is the index of the entry which is replaced next.
+   */
+  size_t next;
+} ngtcp2_crypto_initial_key_cache;
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_initial_key_cache_init` initializes |cache|.
+ */
+NGTCP2_EXTERN void
+ngtcp2_crypto_initial_key_cache_init(ngtcp2_crypto_initial_key_cache *cache);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_write_connection_close_cached` is like
+ * `ngtcp2_crypto_write_connection_close`, but it looks up the keys
+ * derived from |scid| in |cache|, and stores them in |cache| if they
+ * are not found.
+ *
+ * This function returns 0 if it succeeds, or -1.
+ */
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_crypto_write_connection_close_cached(
+    uint8_t *dest, size_t destlen, uint32_t version, const ngtcp2_cid *dcid,
+    const ngtcp2_cid *scid, uint64_t error_code, const uint8_t *reason,
+    size_t reasonlen, ngtcp2_crypto_initial_key_cache *cache);
+
 /**
  * @function
  *
@@ -763,6 +1542,67 @@ NGTCP2_EXTERN ngtcp2_ssize ngtcp2_crypto_write_retry(
     const ngtcp2_cid *scid, const ngtcp2_cid *odcid, const uint8_t *token,
     size_t tokenlen);
 
+/**
+ * @struct
+ *
+ * :type:`ngtcp2_crypto_retry_ctx` holds the AEAD contexts which
+ * compute Retry Integrity Tag.  `ngtcp2_crypto_write_retry` creates
+ * the context for each packet, which is expensive when server answers
+ * a flood of Initial packets with Retry.  This object must not be
+ * shared between threads.
+ */
+typedef struct ngtcp2_crypto_retry_ctx {
+  /**
+   * :member:`aead` is AEAD to compute Retry Integrity Tag.
+   */
+  ngtcp2_crypto_aead aead;
+  /**
+   * :member:`v1_ctx` is AEAD context for
+   * :macro:`NGTCP2_PROTO_VER_V1`.
+   */
+  ngtcp2_crypto_aead_ctx v1_ctx;
+  /**
+   * :member:`v2_draft_ctx` is AEAD context for
+   * :macro:`NGTCP2_PROTO_VER_V2_DRAFT`.
+   */
+  ngtcp2_crypto_aead_ctx v2_draft_ctx;
+} ngtcp2_crypto_retry_ctx;
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_retry_ctx_init` initializes |ctx|.  The caller must
+ * call `ngtcp2_crypto_retry_ctx_free` when |ctx| is no longer used.
+ *
+ * This function returns 0 if it succeeds, or -1.
+ */
+NGTCP2_EXTERN int ngtcp2_crypto_retry_ctx_init(ngtcp2_crypto_retry_ctx *ctx);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_retry_ctx_free` frees resources allocated for
+ * |ctx|.
+ */
+NGTCP2_EXTERN void ngtcp2_crypto_retry_ctx_free(ngtcp2_crypto_retry_ctx *ctx);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_retry_ctx_write_retry` is like
+ * `ngtcp2_crypto_write_retry`, but it computes Retry Integrity Tag
+ * with the AEAD context in |ctx|.  For the other versions than
+ * :macro:`NGTCP2_PROTO_VER_V1` and
+ * :macro:`NGTCP2_PROTO_VER_V2_DRAFT`, it falls back to
+ * `ngtcp2_crypto_write_retry`.
+ *
+ * This function returns 0 if it succeeds, or -1.
+ */
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_crypto_retry_ctx_write_retry(
+    ngtcp2_crypto_retry_ctx *ctx, uint8_t *dest, size_t destlen,
+    uint32_t version, const ngtcp2_cid *dcid, const ngtcp2_cid *scid,
+    const ngtcp2_cid *odcid, const uint8_t *token, size_t tokenlen);
+
 /**
  * @function
  *
@@ -33,6 +33,27 @@
 extern "C" {
 #endif
 
+/**
+ * @macrosection
+ *
+ * BoringSSL specific error codes
+ */
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_CRYPTO_BORINGSSL_ERR_TLS_WANT_PRIVATE_KEY_OPERATION`
+ * is the error code which indicates that TLS handshake routine is
+ * suspended by a private key operation which an application offloads
+ * with ``SSL_PRIVATE_KEY_METHOD``.  See
+ * :macro:`SSL_ERROR_WANT_PRIVATE_KEY_OPERATION` error description
+ * from `SSL_do_handshake`.  This is not a fatal error.  When the
+ * operation completes, resume the handshake by calling
+ * `ngtcp2_crypto_read_write_crypto_data` with |datalen| == 0, and
+ * write packets.
+ */
+#define NGTCP2_CRYPTO_BORINGSSL_ERR_TLS_WANT_PRIVATE_KEY_OPERATION -10001
+
 /**
  * @function
  *
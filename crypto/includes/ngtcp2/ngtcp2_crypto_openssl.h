@@ -61,6 +61,21 @@ extern "C" {
  */
 #define NGTCP2_CRYPTO_OPENSSL_ERR_TLS_WANT_CLIENT_HELLO_CB -10002
 
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_CRYPTO_OPENSSL_ERR_TLS_WANT_ASYNC` is the error code
+ * which indicates that TLS handshake routine is suspended by an
+ * asynchronous operation, e.g., private key signing by an engine or
+ * provider, with ``SSL_MODE_ASYNC`` enabled.  See
+ * :macro:`SSL_ERROR_WANT_ASYNC` and :macro:`SSL_ERROR_WANT_ASYNC_JOB`
+ * error description from `SSL_do_handshake`.  This is not a fatal
+ * error.  When the operation completes, resume the handshake by
+ * calling `ngtcp2_crypto_read_write_crypto_data` with |datalen| ==
+ * 0, and write packets.
+ */
+#define NGTCP2_CRYPTO_OPENSSL_ERR_TLS_WANT_ASYNC -10003
+
 /**
  * @function
  *
@@ -125,6 +140,23 @@ ngtcp2_crypto_openssl_configure_server_context(SSL_CTX *ssl_ctx);
 NGTCP2_EXTERN int
 ngtcp2_crypto_openssl_configure_client_context(SSL_CTX *ssl_ctx);
 
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_openssl_init` fetches the ciphers, message digests,
+ * and HKDF which QUIC uses, and keeps them for the lifetime of the
+ * process.  Without this, OpenSSL 3.0 or later looks up an algorithm
+ * from its provider every time a key is derived or a cipher context
+ * is initialized, which is a noticeable part of the cost of deriving
+ * Initial keys for each new connection.  This function should be
+ * called once before any other function in this library is used, and
+ * it is not thread-safe.  It does nothing for OpenSSL older than
+ * 3.0.
+ *
+ * It returns 0 if it succeeds, or -1.
+ */
+NGTCP2_EXTERN int ngtcp2_crypto_openssl_init(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -239,6 +239,28 @@ NGTCP2_EXTERN int ngtcp2_crypto_picotls_collected_extensions(
     ptls_t *ptls, struct st_ptls_handshake_properties_t *properties,
     ptls_raw_extension_t *extensions);
 
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_picotls_encrypt_hp_mask_cb` encrypts |plaintext| and
+ * produces the header protection mask from the sample at |dest| +
+ * |sample_offset| in a single call to ptls_aead_encrypt_s.  If the
+ * negotiated cipher suite is backed by picotls fusion
+ * (e.g., ptls_fusion_aes128gcm), the mask is computed in the same
+ * pass as the AEAD encryption.  Otherwise, picotls falls back to
+ * encrypting the payload and then the sample.  It can be directly
+ * passed to :member:`ngtcp2_callbacks.encrypt_hp_mask` field.
+ *
+ * This function returns 0 if it succeeds, or
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`.
+ */
+NGTCP2_EXTERN int ngtcp2_crypto_picotls_encrypt_hp_mask_cb(
+    uint8_t *dest, uint8_t *mask, const ngtcp2_crypto_aead *aead,
+    const ngtcp2_crypto_aead_ctx *aead_ctx, const uint8_t *plaintext,
+    size_t plaintextlen, const uint8_t *nonce, size_t noncelen,
+    const uint8_t *aad, size_t aadlen, const ngtcp2_crypto_cipher *hp,
+    const ngtcp2_crypto_cipher_ctx *hp_ctx, size_t sample_offset);
+
 #ifdef __cplusplus
 }
 #endif
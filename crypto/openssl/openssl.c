@@ -42,6 +42,188 @@
 
 #include "shared.h"
 
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static int crypto_initialized;
+static EVP_CIPHER *crypto_aes_128_gcm;
+static EVP_CIPHER *crypto_aes_256_gcm;
+static EVP_CIPHER *crypto_chacha20_poly1305;
+static EVP_CIPHER *crypto_aes_128_ccm;
+static EVP_CIPHER *crypto_aes_128_ctr;
+static EVP_CIPHER *crypto_aes_256_ctr;
+static EVP_CIPHER *crypto_chacha20;
+static EVP_MD *crypto_sha256;
+static EVP_MD *crypto_sha384;
+static EVP_KDF *crypto_hkdf;
+
+int ngtcp2_crypto_openssl_init(void) {
+  if (crypto_initialized) {
+    return 0;
+  }
+
+  crypto_aes_128_gcm = EVP_CIPHER_fetch(NULL, "AES-128-GCM", NULL);
+  if (crypto_aes_128_gcm == NULL) {
+    return -1;
+  }
+
+  crypto_aes_256_gcm = EVP_CIPHER_fetch(NULL, "AES-256-GCM", NULL);
+  if (crypto_aes_256_gcm == NULL) {
+    return -1;
+  }
+
+  crypto_chacha20_poly1305 = EVP_CIPHER_fetch(NULL, "ChaCha20-Poly1305", NULL);
+  if (crypto_chacha20_poly1305 == NULL) {
+    return -1;
+  }
+
+  crypto_aes_128_ccm = EVP_CIPHER_fetch(NULL, "AES-128-CCM", NULL);
+  if (crypto_aes_128_ccm == NULL) {
+    return -1;
+  }
+
+  crypto_aes_128_ctr = EVP_CIPHER_fetch(NULL, "AES-128-CTR", NULL);
+  if (crypto_aes_128_ctr == NULL) {
+    return -1;
+  }
+
+  crypto_aes_256_ctr = EVP_CIPHER_fetch(NULL, "AES-256-CTR", NULL);
+  if (crypto_aes_256_ctr == NULL) {
+    return -1;
+  }
+
+  crypto_chacha20 = EVP_CIPHER_fetch(NULL, "ChaCha20", NULL);
+  if (crypto_chacha20 == NULL) {
+    return -1;
+  }
+
+  crypto_sha256 = EVP_MD_fetch(NULL, "sha256", NULL);
+  if (crypto_sha256 == NULL) {
+    return -1;
+  }
+
+  crypto_sha384 = EVP_MD_fetch(NULL, "sha384", NULL);
+  if (crypto_sha384 == NULL) {
+    return -1;
+  }
+
+  crypto_hkdf = EVP_KDF_fetch(NULL, "hkdf", NULL);
+  if (crypto_hkdf == NULL) {
+    return -1;
+  }
+
+  crypto_initialized = 1;
+
+  return 0;
+}
+
+/*
+ * The following functions return the algorithm fetched by
+ * ngtcp2_crypto_openssl_init if it has been called.  Otherwise, they
+ * fall back to the implicit fetch which OpenSSL performs whenever a
+ * context is initialized with the legacy object.
+ */
+static const EVP_CIPHER *crypto_aead_aes_128_gcm(void) {
+  if (crypto_aes_128_gcm) {
+    return crypto_aes_128_gcm;
+  }
+
+  return EVP_aes_128_gcm();
+}
+
+static const EVP_CIPHER *crypto_aead_aes_256_gcm(void) {
+  if (crypto_aes_256_gcm) {
+    return crypto_aes_256_gcm;
+  }
+
+  return EVP_aes_256_gcm();
+}
+
+static const EVP_CIPHER *crypto_aead_chacha20_poly1305(void) {
+  if (crypto_chacha20_poly1305) {
+    return crypto_chacha20_poly1305;
+  }
+
+  return EVP_chacha20_poly1305();
+}
+
+static const EVP_CIPHER *crypto_aead_aes_128_ccm(void) {
+  if (crypto_aes_128_ccm) {
+    return crypto_aes_128_ccm;
+  }
+
+  return EVP_aes_128_ccm();
+}
+
+static const EVP_CIPHER *crypto_cipher_aes_128_ctr(void) {
+  if (crypto_aes_128_ctr) {
+    return crypto_aes_128_ctr;
+  }
+
+  return EVP_aes_128_ctr();
+}
+
+static const EVP_CIPHER *crypto_cipher_aes_256_ctr(void) {
+  if (crypto_aes_256_ctr) {
+    return crypto_aes_256_ctr;
+  }
+
+  return EVP_aes_256_ctr();
+}
+
+static const EVP_CIPHER *crypto_cipher_chacha20(void) {
+  if (crypto_chacha20) {
+    return crypto_chacha20;
+  }
+
+  return EVP_chacha20();
+}
+
+static const EVP_MD *crypto_md_sha256(void) {
+  if (crypto_sha256) {
+    return crypto_sha256;
+  }
+
+  return EVP_sha256();
+}
+
+static const EVP_MD *crypto_md_sha384(void) {
+  if (crypto_sha384) {
+    return crypto_sha384;
+  }
+
+  return EVP_sha384();
+}
+
+/*
+ * crypto_kdf_hkdf returns HKDF.  The caller must free it with
+ * crypto_kdf_hkdf_free.
+ */
+static EVP_KDF *crypto_kdf_hkdf(void) {
+  if (crypto_hkdf) {
+    return crypto_hkdf;
+  }
+
+  return EVP_KDF_fetch(NULL, "hkdf", NULL);
+}
+
+static void crypto_kdf_hkdf_free(EVP_KDF *kdf) {
+  if (kdf != crypto_hkdf) {
+    EVP_KDF_free(kdf);
+  }
+}
+#else  /* !(OPENSSL_VERSION_NUMBER >= 0x30000000L) */
+int ngtcp2_crypto_openssl_init(void) { return 0; }
+
+#  define crypto_aead_aes_128_gcm EVP_aes_128_gcm
+#  define crypto_aead_aes_256_gcm EVP_aes_256_gcm
+#  define crypto_aead_chacha20_poly1305 EVP_chacha20_poly1305
+#  define crypto_aead_aes_128_ccm EVP_aes_128_ccm
+#  define crypto_cipher_aes_128_ctr EVP_aes_128_ctr
+#  define crypto_cipher_aes_256_ctr EVP_aes_256_ctr
+#  define crypto_cipher_chacha20 EVP_chacha20
+#  define crypto_md_sha256 EVP_sha256
+#  define crypto_md_sha384 EVP_sha384
+#endif /* !(OPENSSL_VERSION_NUMBER >= 0x30000000L) */
+
 static size_t crypto_aead_max_overhead(const EVP_CIPHER *aead) {
   switch (EVP_CIPHER_nid(aead)) {
   case NID_aes_128_gcm:
@@ -58,18 +240,18 @@ static size_t crypto_aead_max_overhead(const EVP_CIPHER *aead) {
 }
 
 ngtcp2_crypto_aead *ngtcp2_crypto_aead_aes_128_gcm(ngtcp2_crypto_aead *aead) {
-  return ngtcp2_crypto_aead_init(aead, (void *)EVP_aes_128_gcm());
+  return ngtcp2_crypto_aead_init(aead, (void *)crypto_aead_aes_128_gcm());
 }
 
 ngtcp2_crypto_md *ngtcp2_crypto_md_sha256(ngtcp2_crypto_md *md) {
-  md->native_handle = (void *)EVP_sha256();
+  md->native_handle = (void *)crypto_md_sha256();
   return md;
 }
 
 ngtcp2_crypto_ctx *ngtcp2_crypto_ctx_initial(ngtcp2_crypto_ctx *ctx) {
-  ngtcp2_crypto_aead_init(&ctx->aead, (void *)EVP_aes_128_gcm());
-  ctx->md.native_handle = (void *)EVP_sha256();
-  ctx->hp.native_handle = (void *)EVP_aes_128_ctr();
+  ngtcp2_crypto_aead_init(&ctx->aead, (void *)crypto_aead_aes_128_gcm());
+  ctx->md.native_handle = (void *)crypto_md_sha256();
+  ctx->hp.native_handle = (void *)crypto_cipher_aes_128_ctr();
   ctx->max_encryption = 0;
   ctx->max_decryption_failure = 0;
   return ctx;
@@ -83,26 +265,26 @@ ngtcp2_crypto_aead *ngtcp2_crypto_aead_init(ngtcp2_crypto_aead *aead,
 }
 
 ngtcp2_crypto_aead *ngtcp2_crypto_aead_retry(ngtcp2_crypto_aead *aead) {
-  return ngtcp2_crypto_aead_init(aead, (void *)EVP_aes_128_gcm());
+  return ngtcp2_crypto_aead_init(aead, (void *)crypto_aead_aes_128_gcm());
 }
 
-static const EVP_CIPHER *crypto_ssl_get_aead(SSL *ssl) {
-  switch (SSL_CIPHER_get_id(SSL_get_current_cipher(ssl))) {
+static const EVP_CIPHER *crypto_get_aead(uint32_t cipher_id) {
+  switch (cipher_id) {
   case TLS1_3_CK_AES_128_GCM_SHA256:
-    return EVP_aes_128_gcm();
+    return crypto_aead_aes_128_gcm();
   case TLS1_3_CK_AES_256_GCM_SHA384:
-    return EVP_aes_256_gcm();
+    return crypto_aead_aes_256_gcm();
   case TLS1_3_CK_CHACHA20_POLY1305_SHA256:
-    return EVP_chacha20_poly1305();
+    return crypto_aead_chacha20_poly1305();
   case TLS1_3_CK_AES_128_CCM_SHA256:
-    return EVP_aes_128_ccm();
+    return crypto_aead_aes_128_ccm();
   default:
     return NULL;
   }
 }
 
-static uint64_t crypto_ssl_get_aead_max_encryption(SSL *ssl) {
-  switch (SSL_CIPHER_get_id(SSL_get_current_cipher(ssl))) {
+static uint64_t crypto_get_aead_max_encryption(uint32_t cipher_id) {
+  switch (cipher_id) {
   case TLS1_3_CK_AES_128_GCM_SHA256:
   case TLS1_3_CK_AES_256_GCM_SHA384:
     return NGTCP2_CRYPTO_MAX_ENCRYPTION_AES_GCM;
@@ -115,8 +297,8 @@ static uint64_t crypto_ssl_get_aead_max_encryption(SSL *ssl) {
   }
 }
 
-static uint64_t crypto_ssl_get_aead_max_decryption_failure(SSL *ssl) {
-  switch (SSL_CIPHER_get_id(SSL_get_current_cipher(ssl))) {
+static uint64_t crypto_get_aead_max_decryption_failure(uint32_t cipher_id) {
+  switch (cipher_id) {
   case TLS1_3_CK_AES_128_GCM_SHA256:
   case TLS1_3_CK_AES_256_GCM_SHA384:
     return NGTCP2_CRYPTO_MAX_DECRYPTION_FAILURE_AES_GCM;
@@ -129,41 +311,61 @@ static uint64_t crypto_ssl_get_aead_max_decryption_failure(SSL *ssl) {
   }
 }
 
-static const EVP_CIPHER *crypto_ssl_get_hp(SSL *ssl) {
-  switch (SSL_CIPHER_get_id(SSL_get_current_cipher(ssl))) {
+static const EVP_CIPHER *crypto_get_hp(uint32_t cipher_id) {
+  switch (cipher_id) {
   case TLS1_3_CK_AES_128_GCM_SHA256:
   case TLS1_3_CK_AES_128_CCM_SHA256:
-    return EVP_aes_128_ctr();
+    return crypto_cipher_aes_128_ctr();
   case TLS1_3_CK_AES_256_GCM_SHA384:
-    return EVP_aes_256_ctr();
+    return crypto_cipher_aes_256_ctr();
   case TLS1_3_CK_CHACHA20_POLY1305_SHA256:
-    return EVP_chacha20();
+    return crypto_cipher_chacha20();
   default:
     return NULL;
   }
 }
 
-static const EVP_MD *crypto_ssl_get_md(SSL *ssl) {
-  switch (SSL_CIPHER_get_id(SSL_get_current_cipher(ssl))) {
+static const EVP_MD *crypto_get_md(uint32_t cipher_id) {
+  switch (cipher_id) {
   case TLS1_3_CK_AES_128_GCM_SHA256:
   case TLS1_3_CK_CHACHA20_POLY1305_SHA256:
   case TLS1_3_CK_AES_128_CCM_SHA256:
-    return EVP_sha256();
+    return crypto_md_sha256();
   case TLS1_3_CK_AES_256_GCM_SHA384:
-    return EVP_sha384();
+    return crypto_md_sha384();
   default:
     return NULL;
   }
 }
 
+static void crypto_ctx_init(ngtcp2_crypto_ctx *ctx, uint32_t cipher_id) {
+  ngtcp2_crypto_aead_init(&ctx->aead, (void *)crypto_get_aead(cipher_id));
+  ctx->md.native_handle = (void *)crypto_get_md(cipher_id);
+  ctx->hp.native_handle = (void *)crypto_get_hp(cipher_id);
+  ctx->max_encryption = crypto_get_aead_max_encryption(cipher_id);
+  ctx->max_decryption_failure =
+      crypto_get_aead_max_decryption_failure(cipher_id);
+}
+
 ngtcp2_crypto_ctx *ngtcp2_crypto_ctx_tls(ngtcp2_crypto_ctx *ctx,
                                          void *tls_native_handle) {
   SSL *ssl = tls_native_handle;
-  ngtcp2_crypto_aead_init(&ctx->aead, (void *)crypto_ssl_get_aead(ssl));
-  ctx->md.native_handle = (void *)crypto_ssl_get_md(ssl);
-  ctx->hp.native_handle = (void *)crypto_ssl_get_hp(ssl);
-  ctx->max_encryption = crypto_ssl_get_aead_max_encryption(ssl);
-  ctx->max_decryption_failure = crypto_ssl_get_aead_max_decryption_failure(ssl);
+  crypto_ctx_init(ctx,
+                  (uint32_t)SSL_CIPHER_get_id(SSL_get_current_cipher(ssl)));
+  return ctx;
+}
+
+ngtcp2_crypto_ctx *ngtcp2_crypto_ctx_cipher_suite(ngtcp2_crypto_ctx *ctx,
+                                                  uint16_t cipher_suite) {
+  /* The ID of TLSv1.3 cipher suite is 0x0300 followed by the 2 bytes
+     cipher suite. */
+  uint32_t cipher_id = 0x03000000u | cipher_suite;
+
+  if (!crypto_get_aead(cipher_id)) {
+    return NULL;
+  }
+
+  crypto_ctx_init(ctx, cipher_id);
   return ctx;
 }
 
@@ -290,6 +492,44 @@ int ngtcp2_crypto_aead_ctx_decrypt_init(ngtcp2_crypto_aead_ctx *aead_ctx,
   return 0;
 }
 
+/*
+ * crypto_aead_ctx_reinit sets |key| to the existing EVP_CIPHER_CTX of
+ * |aead_ctx|.  The IV length and the tag length configured by the
+ * initial setup are retained.
+ */
+static int crypto_aead_ctx_reinit(ngtcp2_crypto_aead_ctx *aead_ctx,
+                                  const ngtcp2_crypto_aead *aead,
+                                  const uint8_t *key, int enc) {
+  EVP_CIPHER_CTX *actx = aead_ctx->native_handle;
+
+  if (EVP_CIPHER_CTX_nid(actx) != EVP_CIPHER_nid(aead->native_handle) ||
+      !EVP_CipherInit_ex(actx, NULL, NULL, key, NULL, enc)) {
+    EVP_CIPHER_CTX_free(actx);
+    aead_ctx->native_handle = NULL;
+    return -1;
+  }
+
+  return 0;
+}
+
+int ngtcp2_crypto_aead_ctx_encrypt_reinit(ngtcp2_crypto_aead_ctx *aead_ctx,
+                                          const ngtcp2_crypto_aead *aead,
+                                          const uint8_t *key,
+                                          size_t noncelen) {
+  (void)noncelen;
+
+  return crypto_aead_ctx_reinit(aead_ctx, aead, key, /* enc = */ 1);
+}
+
+int ngtcp2_crypto_aead_ctx_decrypt_reinit(ngtcp2_crypto_aead_ctx *aead_ctx,
+                                          const ngtcp2_crypto_aead *aead,
+                                          const uint8_t *key,
+                                          size_t noncelen) {
+  (void)noncelen;
+
+  return crypto_aead_ctx_reinit(aead_ctx, aead, key, /* enc = */ 0);
+}
+
 void ngtcp2_crypto_aead_ctx_free(ngtcp2_crypto_aead_ctx *aead_ctx) {
   if (aead_ctx->native_handle) {
     EVP_CIPHER_CTX_free(aead_ctx->native_handle);
@@ -327,7 +567,7 @@ int ngtcp2_crypto_hkdf_extract(uint8_t *dest, const ngtcp2_crypto_md *md,
                                const uint8_t *salt, size_t saltlen) {
 #if OPENSSL_VERSION_NUMBER >= 0x30000000L
   const EVP_MD *prf = md->native_handle;
-  EVP_KDF *kdf = EVP_KDF_fetch(NULL, "hkdf", NULL);
+  EVP_KDF *kdf = crypto_kdf_hkdf();
   EVP_KDF_CTX *kctx = EVP_KDF_CTX_new(kdf);
   int mode = EVP_KDF_HKDF_MODE_EXTRACT_ONLY;
   OSSL_PARAM params[] = {
@@ -342,7 +582,7 @@ int ngtcp2_crypto_hkdf_extract(uint8_t *dest, const ngtcp2_crypto_md *md,
   };
   int rv = 0;
 
-  EVP_KDF_free(kdf);
+  crypto_kdf_hkdf_free(kdf);
 
   if (EVP_KDF_derive(kctx, dest, (size_t)EVP_MD_size(prf), params) <= 0) {
     rv = -1;
@@ -382,7 +622,7 @@ int ngtcp2_crypto_hkdf_expand(uint8_t *dest, size_t destlen,
                               size_t infolen) {
 #if OPENSSL_VERSION_NUMBER >= 0x30000000L
   const EVP_MD *prf = md->native_handle;
-  EVP_KDF *kdf = EVP_KDF_fetch(NULL, "hkdf", NULL);
+  EVP_KDF *kdf = crypto_kdf_hkdf();
   EVP_KDF_CTX *kctx = EVP_KDF_CTX_new(kdf);
   int mode = EVP_KDF_HKDF_MODE_EXPAND_ONLY;
   OSSL_PARAM params[] = {
@@ -397,7 +637,7 @@ int ngtcp2_crypto_hkdf_expand(uint8_t *dest, size_t destlen,
   };
   int rv = 0;
 
-  EVP_KDF_free(kdf);
+  crypto_kdf_hkdf_free(kdf);
 
   if (EVP_KDF_derive(kctx, dest, destlen, params) <= 0) {
     rv = -1;
@@ -436,7 +676,7 @@ int ngtcp2_crypto_hkdf(uint8_t *dest, size_t destlen,
                        const uint8_t *info, size_t infolen) {
 #if OPENSSL_VERSION_NUMBER >= 0x30000000L
   const EVP_MD *prf = md->native_handle;
-  EVP_KDF *kdf = EVP_KDF_fetch(NULL, "hkdf", NULL);
+  EVP_KDF *kdf = crypto_kdf_hkdf();
   EVP_KDF_CTX *kctx = EVP_KDF_CTX_new(kdf);
   OSSL_PARAM params[] = {
       OSSL_PARAM_construct_utf8_string(OSSL_KDF_PARAM_DIGEST,
@@ -451,7 +691,7 @@ int ngtcp2_crypto_hkdf(uint8_t *dest, size_t destlen,
   };
   int rv = 0;
 
-  EVP_KDF_free(kdf);
+  crypto_kdf_hkdf_free(kdf);
 
   if (EVP_KDF_derive(kctx, dest, destlen, params) <= 0) {
     rv = -1;
@@ -524,6 +764,67 @@ int ngtcp2_crypto_encrypt(uint8_t *dest, const ngtcp2_crypto_aead *aead,
   return 0;
 }
 
+int ngtcp2_crypto_encrypt_vec(uint8_t *dest, const ngtcp2_crypto_aead *aead,
+                              const ngtcp2_crypto_aead_ctx *aead_ctx,
+                              const ngtcp2_vec *plaintext, size_t plaintextcnt,
+                              const uint8_t *nonce, size_t noncelen,
+                              const uint8_t *aad, size_t aadlen) {
+  const EVP_CIPHER *cipher = aead->native_handle;
+  size_t taglen = crypto_aead_max_overhead(cipher);
+  EVP_CIPHER_CTX *actx = aead_ctx->native_handle;
+  uint8_t *p = dest;
+  size_t i;
+  int len;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+  OSSL_PARAM params[2];
+#endif /* OPENSSL_VERSION_NUMBER >= 0x30000000L */
+
+  /* AES-CCM takes plaintext in a single EVP_EncryptUpdate call. */
+  if (EVP_CIPHER_nid(cipher) == NID_aes_128_ccm) {
+    return ngtcp2_crypto_encrypt_vec_gather(dest, aead, aead_ctx, plaintext,
+                                            plaintextcnt, nonce, noncelen, aad,
+                                            aadlen);
+  }
+
+  (void)noncelen;
+
+  if (!EVP_EncryptInit_ex(actx, NULL, NULL, NULL, nonce) ||
+      !EVP_EncryptUpdate(actx, NULL, &len, aad, (int)aadlen)) {
+    return -1;
+  }
+
+  for (i = 0; i < plaintextcnt; ++i) {
+    if (!EVP_EncryptUpdate(actx, p, &len, plaintext[i].base,
+                           (int)plaintext[i].len)) {
+      return -1;
+    }
+
+    p += len;
+  }
+
+  if (!EVP_EncryptFinal_ex(actx, p, &len)) {
+    return -1;
+  }
+
+  p += len;
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+  params[0] =
+      OSSL_PARAM_construct_octet_string(OSSL_CIPHER_PARAM_AEAD_TAG, p, taglen);
+  params[1] = OSSL_PARAM_construct_end();
+
+  if (!EVP_CIPHER_CTX_get_params(actx, params)) {
+    return -1;
+  }
+#else  /* !(OPENSSL_VERSION_NUMBER >= 0x30000000L) */
+  if (!EVP_CIPHER_CTX_ctrl(actx, EVP_CTRL_AEAD_GET_TAG, (int)taglen, p)) {
+    return -1;
+  }
+#endif /* !(OPENSSL_VERSION_NUMBER >= 0x30000000L) */
+
+  return 0;
+}
+
 int ngtcp2_crypto_decrypt(uint8_t *dest, const ngtcp2_crypto_aead *aead,
                           const ngtcp2_crypto_aead_ctx *aead_ctx,
                           const uint8_t *ciphertext, size_t ciphertextlen,
@@ -598,7 +899,11 @@ int ngtcp2_crypto_read_write_crypto_data(ngtcp2_conn *conn,
   int rv;
   int err;
 
-  if (SSL_provide_quic_data(
+  /* datalen == 0 may resume the handshake suspended by an
+     asynchronous operation.  Do not provide data, which could be
+     rejected at a lower encryption level than the current one. */
+  if (datalen &&
+      SSL_provide_quic_data(
           ssl, ngtcp2_crypto_openssl_from_ngtcp2_crypto_level(crypto_level),
           data, datalen) != 1) {
     return -1;
@@ -616,6 +921,11 @@ int ngtcp2_crypto_read_write_crypto_data(ngtcp2_conn *conn,
         return NGTCP2_CRYPTO_OPENSSL_ERR_TLS_WANT_CLIENT_HELLO_CB;
       case SSL_ERROR_WANT_X509_LOOKUP:
         return NGTCP2_CRYPTO_OPENSSL_ERR_TLS_WANT_X509_LOOKUP;
+#ifdef SSL_ERROR_WANT_ASYNC
+      case SSL_ERROR_WANT_ASYNC:
+      case SSL_ERROR_WANT_ASYNC_JOB:
+        return NGTCP2_CRYPTO_OPENSSL_ERR_TLS_WANT_ASYNC;
+#endif /* SSL_ERROR_WANT_ASYNC */
       case SSL_ERROR_SSL:
         return -1;
       default:
@@ -27,6 +27,7 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <ngtcp2/ngtcp2_crypto.h>
@@ -68,15 +69,8 @@ ngtcp2_crypto_aead *ngtcp2_crypto_aead_retry(ngtcp2_crypto_aead *aead) {
   return ngtcp2_crypto_aead_init(aead, (void *)&ptls_openssl_aes128gcm);
 }
 
-static const ptls_aead_algorithm_t *crypto_ptls_get_aead(ptls_t *ptls) {
-  ptls_cipher_suite_t *cs = ptls_get_cipher(ptls);
-
-  return cs->aead;
-}
-
-static uint64_t crypto_ptls_get_aead_max_encryption(ptls_t *ptls) {
-  ptls_cipher_suite_t *cs = ptls_get_cipher(ptls);
-
+static uint64_t
+crypto_get_aead_max_encryption(const ptls_cipher_suite_t *cs) {
   if (cs->aead == &ptls_openssl_aes128gcm ||
       cs->aead == &ptls_openssl_aes256gcm) {
     return NGTCP2_CRYPTO_MAX_ENCRYPTION_AES_GCM;
@@ -89,9 +83,8 @@ static uint64_t crypto_ptls_get_aead_max_encryption(ptls_t *ptls) {
   return 0;
 }
 
-static uint64_t crypto_ptls_get_aead_max_decryption_failure(ptls_t *ptls) {
-  ptls_cipher_suite_t *cs = ptls_get_cipher(ptls);
-
+static uint64_t
+crypto_get_aead_max_decryption_failure(const ptls_cipher_suite_t *cs) {
   if (cs->aead == &ptls_openssl_aes128gcm ||
       cs->aead == &ptls_openssl_aes256gcm) {
     return NGTCP2_CRYPTO_MAX_DECRYPTION_FAILURE_AES_GCM;
@@ -104,9 +97,8 @@ static uint64_t crypto_ptls_get_aead_max_decryption_failure(ptls_t *ptls) {
   return 0;
 }
 
-static const ptls_cipher_algorithm_t *crypto_ptls_get_hp(ptls_t *ptls) {
-  ptls_cipher_suite_t *cs = ptls_get_cipher(ptls);
-
+static const ptls_cipher_algorithm_t *
+crypto_get_hp(const ptls_cipher_suite_t *cs) {
   if (cs->aead == &ptls_openssl_aes128gcm) {
     return &ptls_openssl_aes128ctr;
   }
@@ -122,25 +114,36 @@ static const ptls_cipher_algorithm_t *crypto_ptls_get_hp(ptls_t *ptls) {
   return NULL;
 }
 
-static const ptls_hash_algorithm_t *crypto_ptls_get_md(ptls_t *ptls) {
-  ptls_cipher_suite_t *cs = ptls_get_cipher(ptls);
-
-  return cs->hash;
+static void crypto_ctx_init(ngtcp2_crypto_ctx *ctx,
+                            const ptls_cipher_suite_t *cs) {
+  ngtcp2_crypto_aead_init(&ctx->aead, (void *)cs->aead);
+  ctx->md.native_handle = (void *)cs->hash;
+  ctx->hp.native_handle = (void *)crypto_get_hp(cs);
+  ctx->max_encryption = crypto_get_aead_max_encryption(cs);
+  ctx->max_decryption_failure = crypto_get_aead_max_decryption_failure(cs);
 }
 
 ngtcp2_crypto_ctx *ngtcp2_crypto_ctx_tls(ngtcp2_crypto_ctx *ctx,
                                          void *tls_native_handle) {
   ngtcp2_crypto_picotls_ctx *cptls = tls_native_handle;
-  ngtcp2_crypto_aead_init(&ctx->aead,
-                          (void *)crypto_ptls_get_aead(cptls->ptls));
-  ctx->md.native_handle = (void *)crypto_ptls_get_md(cptls->ptls);
-  ctx->hp.native_handle = (void *)crypto_ptls_get_hp(cptls->ptls);
-  ctx->max_encryption = crypto_ptls_get_aead_max_encryption(cptls->ptls);
-  ctx->max_decryption_failure =
-      crypto_ptls_get_aead_max_decryption_failure(cptls->ptls);
+  crypto_ctx_init(ctx, ptls_get_cipher(cptls->ptls));
   return ctx;
 }
 
+ngtcp2_crypto_ctx *ngtcp2_crypto_ctx_cipher_suite(ngtcp2_crypto_ctx *ctx,
+                                                  uint16_t cipher_suite) {
+  ptls_cipher_suite_t **cs;
+
+  for (cs = ptls_openssl_cipher_suites; *cs; ++cs) {
+    if ((*cs)->id == cipher_suite && crypto_get_hp(*cs)) {
+      crypto_ctx_init(ctx, *cs);
+      return ctx;
+    }
+  }
+
+  return NULL;
+}
+
 ngtcp2_crypto_ctx *ngtcp2_crypto_ctx_tls_early(ngtcp2_crypto_ctx *ctx,
                                                void *tls_native_handle) {
   return ngtcp2_crypto_ctx_tls(ctx, tls_native_handle);
@@ -212,6 +215,55 @@ int ngtcp2_crypto_aead_ctx_decrypt_init(ngtcp2_crypto_aead_ctx *aead_ctx,
   return 0;
 }
 
+/*
+ * crypto_aead_ctx_reinit sets up the existing ptls_aead_context_t of
+ * |aead_ctx| with |key| in place.  It does what ptls_aead_new_direct
+ * does, but without allocating the context.
+ */
+static int crypto_aead_ctx_reinit(ngtcp2_crypto_aead_ctx *aead_ctx,
+                                  const ngtcp2_crypto_aead *aead,
+                                  const uint8_t *key, int is_enc) {
+  const ptls_aead_algorithm_t *cipher = aead->native_handle;
+  ptls_aead_context_t *actx = aead_ctx->native_handle;
+  static const uint8_t iv[PTLS_MAX_IV_SIZE] = {0};
+
+  if (actx->algo != cipher) {
+    ptls_aead_free(actx);
+    aead_ctx->native_handle = NULL;
+    return -1;
+  }
+
+  actx->dispose_crypto(actx);
+
+  *actx = (ptls_aead_context_t){cipher};
+
+  if (cipher->setup_crypto(actx, is_enc, key, iv) != 0) {
+    free(actx);
+    aead_ctx->native_handle = NULL;
+    return -1;
+  }
+
+  return 0;
+}
+
+int ngtcp2_crypto_aead_ctx_encrypt_reinit(ngtcp2_crypto_aead_ctx *aead_ctx,
+                                          const ngtcp2_crypto_aead *aead,
+                                          const uint8_t *key,
+                                          size_t noncelen) {
+  (void)noncelen;
+
+  return crypto_aead_ctx_reinit(aead_ctx, aead, key, /* is_enc = */ 1);
+}
+
+int ngtcp2_crypto_aead_ctx_decrypt_reinit(ngtcp2_crypto_aead_ctx *aead_ctx,
+                                          const ngtcp2_crypto_aead *aead,
+                                          const uint8_t *key,
+                                          size_t noncelen) {
+  (void)noncelen;
+
+  return crypto_aead_ctx_reinit(aead_ctx, aead, key, /* is_enc = */ 0);
+}
+
 void ngtcp2_crypto_aead_ctx_free(ngtcp2_crypto_aead_ctx *aead_ctx) {
   if (aead_ctx->native_handle) {
     ptls_aead_free(aead_ctx->native_handle);
@@ -314,6 +366,35 @@ int ngtcp2_crypto_encrypt(uint8_t *dest, const ngtcp2_crypto_aead *aead,
   return 0;
 }
 
+int ngtcp2_crypto_encrypt_vec(uint8_t *dest, const ngtcp2_crypto_aead *aead,
+                              const ngtcp2_crypto_aead_ctx *aead_ctx,
+                              const ngtcp2_vec *plaintext, size_t plaintextcnt,
+                              const uint8_t *nonce, size_t noncelen,
+                              const uint8_t *aad, size_t aadlen) {
+  ptls_aead_context_t *actx = aead_ctx->native_handle;
+  ptls_iovec_t input[64];
+  size_t i;
+
+  if (plaintextcnt > sizeof(input) / sizeof(input[0])) {
+    return ngtcp2_crypto_encrypt_vec_gather(dest, aead, aead_ctx, plaintext,
+                                            plaintextcnt, nonce, noncelen, aad,
+                                            aadlen);
+  }
+
+  for (i = 0; i < plaintextcnt; ++i) {
+    input[i] = ptls_iovec_init(plaintext[i].base, plaintext[i].len);
+  }
+
+  ptls_aead_xor_iv(actx, nonce, noncelen);
+
+  ptls_aead_encrypt_v(actx, dest, input, plaintextcnt, 0, aad, aadlen);
+
+  /* zero-out static iv once again */
+  ptls_aead_xor_iv(actx, nonce, noncelen);
+
+  return 0;
+}
+
 int ngtcp2_crypto_decrypt(uint8_t *dest, const ngtcp2_crypto_aead *aead,
                           const ngtcp2_crypto_aead_ctx *aead_ctx,
                           const uint8_t *ciphertext, size_t ciphertextlen,
@@ -350,6 +431,34 @@ int ngtcp2_crypto_hp_mask(uint8_t *dest, const ngtcp2_crypto_cipher *hp,
   return 0;
 }
 
+int ngtcp2_crypto_picotls_encrypt_hp_mask_cb(
+    uint8_t *dest, uint8_t *mask, const ngtcp2_crypto_aead *aead,
+    const ngtcp2_crypto_aead_ctx *aead_ctx, const uint8_t *plaintext,
+    size_t plaintextlen, const uint8_t *nonce, size_t noncelen,
+    const uint8_t *aad, size_t aadlen, const ngtcp2_crypto_cipher *hp,
+    const ngtcp2_crypto_cipher_ctx *hp_ctx, size_t sample_offset) {
+  ptls_aead_context_t *actx = aead_ctx->native_handle;
+  ptls_aead_supplementary_encryption_t supp;
+
+  (void)aead;
+  (void)hp;
+
+  supp.ctx = hp_ctx->native_handle;
+  supp.input = dest + sample_offset;
+
+  ptls_aead_xor_iv(actx, nonce, noncelen);
+
+  ptls_aead_encrypt_s(actx, dest, plaintext, plaintextlen, 0, aad, aadlen,
+                      &supp);
+
+  /* zero-out static iv once again */
+  ptls_aead_xor_iv(actx, nonce, noncelen);
+
+  memcpy(mask, supp.output, NGTCP2_HP_MASKLEN);
+
+  return 0;
+}
+
 int ngtcp2_crypto_read_write_crypto_data(ngtcp2_conn *conn,
                                          ngtcp2_crypto_level crypto_level,
                                          const uint8_t *data, size_t datalen) {
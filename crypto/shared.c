@@ -43,6 +43,37 @@ ngtcp2_crypto_md *ngtcp2_crypto_md_init(ngtcp2_crypto_md *md,
   return md;
 }
 
+/*
+ * NGTCP2_CRYPTO_HKDF_LABEL builds HkdfLabel of RFC 8446 except for
+ * its leading length field at compile time.  |N| is the length of
+ * "tls13 " plus |S| as an escaped octet, and the context is empty.
+ */
+#define NGTCP2_CRYPTO_HKDF_LABEL(N, S) N "tls13 " S "\x00"
+
+/*
+ * crypto_hkdf_expand_hkdf_label is like
+ * ngtcp2_crypto_hkdf_expand_label, but it takes |hkdf_label| of
+ * length |hkdf_labellen| which is built by NGTCP2_CRYPTO_HKDF_LABEL.
+ */
+static int crypto_hkdf_expand_hkdf_label(uint8_t *dest, size_t destlen,
+                                         const ngtcp2_crypto_md *md,
+                                         const uint8_t *secret,
+                                         size_t secretlen,
+                                         const uint8_t *hkdf_label,
+                                         size_t hkdf_labellen) {
+  uint8_t info[64];
+
+  assert(2 + hkdf_labellen <= sizeof(info));
+  assert((size_t)hkdf_label[0] + 2 == hkdf_labellen);
+
+  info[0] = (uint8_t)(destlen / 256);
+  info[1] = (uint8_t)(destlen % 256);
+  memcpy(info + 2, hkdf_label, hkdf_labellen);
+
+  return ngtcp2_crypto_hkdf_expand(dest, destlen, md, secret, secretlen, info,
+                                   2 + hkdf_labellen);
+}
+
 int ngtcp2_crypto_hkdf_expand_label(uint8_t *dest, size_t destlen,
                                     const ngtcp2_crypto_md *md,
                                     const uint8_t *secret, size_t secretlen,
@@ -71,8 +102,12 @@ int ngtcp2_crypto_derive_initial_secrets(uint32_t version, uint8_t *rx_secret,
                                          uint8_t *initial_secret,
                                          const ngtcp2_cid *client_dcid,
                                          ngtcp2_crypto_side side) {
-  static const uint8_t CLABEL[] = "client in";
-  static const uint8_t SLABEL[] = "server in";
+  /* The length of both secrets is fixed, so that the whole info is
+     built at compile time. */
+  static const uint8_t CINFO[] =
+      "\x00\x20" NGTCP2_CRYPTO_HKDF_LABEL("\x0f", "client in");
+  static const uint8_t SINFO[] =
+      "\x00\x20" NGTCP2_CRYPTO_HKDF_LABEL("\x0f", "server in");
   uint8_t initial_secret_buf[NGTCP2_CRYPTO_INITIAL_SECRETLEN];
   uint8_t *client_secret;
   uint8_t *server_secret;
@@ -113,14 +148,14 @@ int ngtcp2_crypto_derive_initial_secrets(uint32_t version, uint8_t *rx_secret,
     server_secret = rx_secret;
   }
 
-  if (ngtcp2_crypto_hkdf_expand_label(
-          client_secret, NGTCP2_CRYPTO_INITIAL_SECRETLEN, &ctx.md,
-          initial_secret, NGTCP2_CRYPTO_INITIAL_SECRETLEN, CLABEL,
-          sizeof(CLABEL) - 1) != 0 ||
-      ngtcp2_crypto_hkdf_expand_label(
-          server_secret, NGTCP2_CRYPTO_INITIAL_SECRETLEN, &ctx.md,
-          initial_secret, NGTCP2_CRYPTO_INITIAL_SECRETLEN, SLABEL,
-          sizeof(SLABEL) - 1) != 0) {
+  if (ngtcp2_crypto_hkdf_expand(client_secret, NGTCP2_CRYPTO_INITIAL_SECRETLEN,
+                                &ctx.md, initial_secret,
+                                NGTCP2_CRYPTO_INITIAL_SECRETLEN, CINFO,
+                                sizeof(CINFO) - 1) != 0 ||
+      ngtcp2_crypto_hkdf_expand(server_secret, NGTCP2_CRYPTO_INITIAL_SECRETLEN,
+                                &ctx.md, initial_secret,
+                                NGTCP2_CRYPTO_INITIAL_SECRETLEN, SINFO,
+                                sizeof(SINFO) - 1) != 0) {
     return -1;
   }
 
@@ -136,12 +171,18 @@ int ngtcp2_crypto_derive_packet_protection_key(
     uint8_t *key, uint8_t *iv, uint8_t *hp_key, uint32_t version,
     const ngtcp2_crypto_aead *aead, const ngtcp2_crypto_md *md,
     const uint8_t *secret, size_t secretlen) {
-  static const uint8_t KEY_LABEL_V1[] = "quic key";
-  static const uint8_t IV_LABEL_V1[] = "quic iv";
-  static const uint8_t HP_KEY_LABEL_V1[] = "quic hp";
-  static const uint8_t KEY_LABEL_V2_DRAFT[] = "quicv2 key";
-  static const uint8_t IV_LABEL_V2_DRAFT[] = "quicv2 iv";
-  static const uint8_t HP_KEY_LABEL_V2_DRAFT[] = "quicv2 hp";
+  static const uint8_t KEY_LABEL_V1[] =
+      NGTCP2_CRYPTO_HKDF_LABEL("\x0e", "quic key");
+  static const uint8_t IV_LABEL_V1[] =
+      NGTCP2_CRYPTO_HKDF_LABEL("\x0d", "quic iv");
+  static const uint8_t HP_KEY_LABEL_V1[] =
+      NGTCP2_CRYPTO_HKDF_LABEL("\x0d", "quic hp");
+  static const uint8_t KEY_LABEL_V2_DRAFT[] =
+      NGTCP2_CRYPTO_HKDF_LABEL("\x10", "quicv2 key");
+  static const uint8_t IV_LABEL_V2_DRAFT[] =
+      NGTCP2_CRYPTO_HKDF_LABEL("\x0f", "quicv2 iv");
+  static const uint8_t HP_KEY_LABEL_V2_DRAFT[] =
+      NGTCP2_CRYPTO_HKDF_LABEL("\x0f", "quicv2 hp");
   size_t keylen = ngtcp2_crypto_aead_keylen(aead);
   size_t ivlen = ngtcp2_crypto_packet_protection_ivlen(aead);
   const uint8_t *key_label;
@@ -169,19 +210,19 @@ int ngtcp2_crypto_derive_packet_protection_key(
     hp_key_labellen = sizeof(HP_KEY_LABEL_V1) - 1;
   }
 
-  if (ngtcp2_crypto_hkdf_expand_label(key, keylen, md, secret, secretlen,
-                                      key_label, key_labellen) != 0) {
+  if (crypto_hkdf_expand_hkdf_label(key, keylen, md, secret, secretlen,
+                                    key_label, key_labellen) != 0) {
     return -1;
   }
 
-  if (ngtcp2_crypto_hkdf_expand_label(iv, ivlen, md, secret, secretlen,
-                                      iv_label, iv_labellen) != 0) {
+  if (crypto_hkdf_expand_hkdf_label(iv, ivlen, md, secret, secretlen,
+                                    iv_label, iv_labellen) != 0) {
     return -1;
   }
 
   if (hp_key != NULL &&
-      ngtcp2_crypto_hkdf_expand_label(hp_key, keylen, md, secret, secretlen,
-                                      hp_key_label, hp_key_labellen) != 0) {
+      crypto_hkdf_expand_hkdf_label(hp_key, keylen, md, secret, secretlen,
+                                    hp_key_label, hp_key_labellen) != 0) {
     return -1;
   }
 
@@ -192,10 +233,10 @@ int ngtcp2_crypto_update_traffic_secret(uint8_t *dest,
                                         const ngtcp2_crypto_md *md,
                                         const uint8_t *secret,
                                         size_t secretlen) {
-  static const uint8_t LABEL[] = "quic ku";
+  static const uint8_t LABEL[] = NGTCP2_CRYPTO_HKDF_LABEL("\x0d", "quic ku");
 
-  if (ngtcp2_crypto_hkdf_expand_label(dest, secretlen, md, secret, secretlen,
-                                      LABEL, sizeof(LABEL) - 1) != 0) {
+  if (crypto_hkdf_expand_hkdf_label(dest, secretlen, md, secret, secretlen,
+                                    LABEL, sizeof(LABEL) - 1) != 0) {
     return -1;
   }
 
@@ -294,7 +335,11 @@ int ngtcp2_crypto_derive_and_install_rx_key(ngtcp2_conn *conn, uint8_t *key,
     }
     break;
   case NGTCP2_CRYPTO_LEVEL_APPLICATION:
-    if (!ngtcp2_conn_is_server(conn)) {
+    /* The connection restored from a snapshot has completed the
+       handshake and has the remote transport parameters, but no TLS
+       session. */
+    if (!ngtcp2_conn_is_server(conn) &&
+        !ngtcp2_conn_get_handshake_completed(conn)) {
       rv = ngtcp2_crypto_set_remote_transport_params(conn, tls);
       if (rv != 0) {
         goto fail;
@@ -461,6 +506,16 @@ fail:
   return -1;
 }
 
+int ngtcp2_crypto_derive_offload_key(ngtcp2_conn *conn, uint8_t *key,
+                                     uint8_t *iv, uint8_t *hp,
+                                     const uint8_t *secret, size_t secretlen) {
+  const ngtcp2_crypto_ctx *ctx = ngtcp2_conn_get_crypto_ctx(conn);
+
+  return ngtcp2_crypto_derive_packet_protection_key(
+      key, iv, hp, ngtcp2_conn_get_negotiated_version(conn), &ctx->aead,
+      &ctx->md, secret, secretlen);
+}
+
 int ngtcp2_crypto_derive_and_install_initial_key(
     ngtcp2_conn *conn, uint8_t *rx_secret, uint8_t *tx_secret,
     uint8_t *initial_secret, uint8_t *rx_key, uint8_t *rx_iv,
@@ -719,6 +774,147 @@ int ngtcp2_crypto_update_key(
     ngtcp2_crypto_aead_ctx *tx_aead_ctx, uint8_t *tx_key, uint8_t *tx_iv,
     const uint8_t *current_rx_secret, const uint8_t *current_tx_secret,
     size_t secretlen) {
+  return ngtcp2_crypto_update_key_pooled(
+      conn, rx_secret, tx_secret, rx_aead_ctx, rx_key, rx_iv, tx_aead_ctx,
+      tx_key, tx_iv, current_rx_secret, current_tx_secret, secretlen, NULL);
+}
+
+void ngtcp2_crypto_aead_ctx_pool_init(ngtcp2_crypto_aead_ctx_pool *pool) {
+  memset(pool, 0, sizeof(*pool));
+}
+
+void ngtcp2_crypto_aead_ctx_pool_free(ngtcp2_crypto_aead_ctx_pool *pool) {
+  ngtcp2_crypto_aead_ctx_pool_entry *ent;
+  ngtcp2_crypto_aead_ctx aead_ctx;
+  size_t i;
+
+  for (i = 0; i < NGTCP2_CRYPTO_AEAD_CTX_POOL_SIZE; ++i) {
+    ent = &pool->ents[i];
+
+    if (ent->native_handle && !ent->in_use) {
+      aead_ctx.native_handle = ent->native_handle;
+      ngtcp2_crypto_aead_ctx_free(&aead_ctx);
+    }
+  }
+
+  memset(pool, 0, sizeof(*pool));
+}
+
+/*
+ * crypto_aead_ctx_pool_init initializes |aead_ctx| for encryption if
+ * |encrypt| is nonzero, or decryption.  It re-keys a released context
+ * object in |pool| which was initialized with |aead| for the same
+ * direction if there is one.  Otherwise, it creates a new one, and
+ * starts tracking it if |pool| has a vacant entry.
+ */
+static int crypto_aead_ctx_pool_init(ngtcp2_crypto_aead_ctx_pool *pool,
+                                     ngtcp2_crypto_aead_ctx *aead_ctx,
+                                     const ngtcp2_crypto_aead *aead,
+                                     const uint8_t *key, size_t noncelen,
+                                     int encrypt) {
+  ngtcp2_crypto_aead_ctx_pool_entry *ent, *vacant = NULL;
+  size_t i;
+  int rv;
+
+  for (i = 0; i < NGTCP2_CRYPTO_AEAD_CTX_POOL_SIZE; ++i) {
+    ent = &pool->ents[i];
+
+    if (!ent->native_handle) {
+      if (!vacant) {
+        vacant = ent;
+      }
+      continue;
+    }
+
+    if (ent->in_use || ent->aead != aead->native_handle ||
+        ent->encrypt != encrypt) {
+      continue;
+    }
+
+    aead_ctx->native_handle = ent->native_handle;
+
+    rv = encrypt ? ngtcp2_crypto_aead_ctx_encrypt_reinit(aead_ctx, aead, key,
+                                                         noncelen)
+                 : ngtcp2_crypto_aead_ctx_decrypt_reinit(aead_ctx, aead, key,
+                                                         noncelen);
+    if (rv == 0) {
+      ent->in_use = 1;
+      return 0;
+    }
+
+    /* The context object has been freed.  Reuse the entry for the new
+       one. */
+    memset(ent, 0, sizeof(*ent));
+    vacant = ent;
+
+    break;
+  }
+
+  rv = encrypt
+           ? ngtcp2_crypto_aead_ctx_encrypt_init(aead_ctx, aead, key, noncelen)
+           : ngtcp2_crypto_aead_ctx_decrypt_init(aead_ctx, aead, key, noncelen);
+  if (rv != 0) {
+    return -1;
+  }
+
+  if (vacant) {
+    vacant->native_handle = aead_ctx->native_handle;
+    vacant->aead = aead->native_handle;
+    vacant->encrypt = (uint8_t)encrypt;
+    vacant->in_use = 1;
+  }
+
+  return 0;
+}
+
+int ngtcp2_crypto_aead_ctx_pool_encrypt_init(ngtcp2_crypto_aead_ctx_pool *pool,
+                                             ngtcp2_crypto_aead_ctx *aead_ctx,
+                                             const ngtcp2_crypto_aead *aead,
+                                             const uint8_t *key,
+                                             size_t noncelen) {
+  return crypto_aead_ctx_pool_init(pool, aead_ctx, aead, key, noncelen,
+                                   /* encrypt = */ 1);
+}
+
+int ngtcp2_crypto_aead_ctx_pool_decrypt_init(ngtcp2_crypto_aead_ctx_pool *pool,
+                                             ngtcp2_crypto_aead_ctx *aead_ctx,
+                                             const ngtcp2_crypto_aead *aead,
+                                             const uint8_t *key,
+                                             size_t noncelen) {
+  return crypto_aead_ctx_pool_init(pool, aead_ctx, aead, key, noncelen,
+                                   /* encrypt = */ 0);
+}
+
+void ngtcp2_crypto_aead_ctx_pool_release(ngtcp2_crypto_aead_ctx_pool *pool,
+                                         ngtcp2_crypto_aead_ctx *aead_ctx) {
+  ngtcp2_crypto_aead_ctx_pool_entry *ent;
+  size_t i;
+
+  if (!aead_ctx->native_handle) {
+    return;
+  }
+
+  for (i = 0; i < NGTCP2_CRYPTO_AEAD_CTX_POOL_SIZE; ++i) {
+    ent = &pool->ents[i];
+
+    if (ent->native_handle == aead_ctx->native_handle) {
+      assert(ent->in_use);
+
+      ent->in_use = 0;
+
+      return;
+    }
+  }
+
+  ngtcp2_crypto_aead_ctx_free(aead_ctx);
+}
+
+int ngtcp2_crypto_update_key_pooled(
+    ngtcp2_conn *conn, uint8_t *rx_secret, uint8_t *tx_secret,
+    ngtcp2_crypto_aead_ctx *rx_aead_ctx, uint8_t *rx_key, uint8_t *rx_iv,
+    ngtcp2_crypto_aead_ctx *tx_aead_ctx, uint8_t *tx_key, uint8_t *tx_iv,
+    const uint8_t *current_rx_secret, const uint8_t *current_tx_secret,
+    size_t secretlen, ngtcp2_crypto_aead_ctx_pool *pool) {
   const ngtcp2_crypto_ctx *ctx = ngtcp2_conn_get_crypto_ctx(conn);
   const ngtcp2_crypto_aead *aead = &ctx->aead;
   const ngtcp2_crypto_md *md = &ctx->md;
@@ -745,6 +941,22 @@ int ngtcp2_crypto_update_key(
     return -1;
   }
 
+  if (pool) {
+    if (ngtcp2_crypto_aead_ctx_pool_decrypt_init(pool, rx_aead_ctx, aead,
+                                                 rx_key, ivlen) != 0) {
+      return -1;
+    }
+
+    if (ngtcp2_crypto_aead_ctx_pool_encrypt_init(pool, tx_aead_ctx, aead,
+                                                 tx_key, ivlen) != 0) {
+      ngtcp2_crypto_aead_ctx_pool_release(pool, rx_aead_ctx);
+      rx_aead_ctx->native_handle = NULL;
+      return -1;
+    }
+
+    return 0;
+  }
+
   if (ngtcp2_crypto_aead_ctx_decrypt_init(rx_aead_ctx, aead, rx_key, ivlen) !=
       0) {
     return -1;
@@ -772,6 +984,56 @@ int ngtcp2_crypto_encrypt_cb(uint8_t *dest, const ngtcp2_crypto_aead *aead,
   return 0;
 }
 
+int ngtcp2_crypto_encrypt_vec_cb(uint8_t *dest, const ngtcp2_crypto_aead *aead,
+                                 const ngtcp2_crypto_aead_ctx *aead_ctx,
+                                 const ngtcp2_vec *plaintext,
+                                 size_t plaintextcnt, const uint8_t *nonce,
+                                 size_t noncelen, const uint8_t *aad,
+                                 size_t aadlen) {
+  if (ngtcp2_crypto_encrypt_vec(dest, aead, aead_ctx, plaintext, plaintextcnt,
+                                nonce, noncelen, aad, aadlen) != 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+  return 0;
+}
+
+int ngtcp2_crypto_encrypt_vec_gather(
+    uint8_t *dest, const ngtcp2_crypto_aead *aead,
+    const ngtcp2_crypto_aead_ctx *aead_ctx, const ngtcp2_vec *plaintext,
+    size_t plaintextcnt, const uint8_t *nonce, size_t noncelen,
+    const uint8_t *aad, size_t aadlen) {
+  uint8_t *p = dest;
+  size_t i;
+
+  for (i = 0; i < plaintextcnt; ++i) {
+    if (plaintext[i].base != p) {
+      memcpy(p, plaintext[i].base, plaintext[i].len);
+    }
+
+    p += plaintext[i].len;
+  }
+
+  return ngtcp2_crypto_encrypt(dest, aead, aead_ctx, dest, (size_t)(p - dest),
+                               nonce, noncelen, aad, aadlen);
+}
+
+int ngtcp2_crypto_encrypt_batch_cb(const ngtcp2_crypto_aead *aead,
+                                   const ngtcp2_crypto_aead_ctx *aead_ctx,
+                                   const ngtcp2_encrypt_op *ops,
+                                   size_t opslen) {
+  size_t i;
+
+  for (i = 0; i < opslen; ++i) {
+    if (ngtcp2_crypto_encrypt(ops[i].dest, aead, aead_ctx, ops[i].plaintext,
+                              ops[i].plaintextlen, ops[i].nonce,
+                              ops[i].noncelen, ops[i].aad,
+                              ops[i].aadlen) != 0) {
+      return NGTCP2_ERR_CALLBACK_FAILURE;
+    }
+  }
+  return 0;
+}
+
 int ngtcp2_crypto_decrypt_cb(uint8_t *dest, const ngtcp2_crypto_aead *aead,
                              const ngtcp2_crypto_aead_ctx *aead_ctx,
                              const uint8_t *ciphertext, size_t ciphertextlen,
@@ -793,6 +1055,22 @@ int ngtcp2_crypto_hp_mask_cb(uint8_t *dest, const ngtcp2_crypto_cipher *hp,
   return 0;
 }
 
+int ngtcp2_crypto_hp_mask_batch_cb(uint8_t *dest,
+                                   const ngtcp2_crypto_cipher *hp,
+                                   const ngtcp2_crypto_cipher_ctx *hp_ctx,
+                                   const uint8_t *const *samples,
+                                   size_t nsamples) {
+  size_t i;
+
+  for (i = 0; i < nsamples; ++i) {
+    if (ngtcp2_crypto_hp_mask(dest + i * NGTCP2_HP_SAMPLELEN, hp, hp_ctx,
+                              samples[i]) != 0) {
+      return NGTCP2_ERR_CALLBACK_FAILURE;
+    }
+  }
+  return 0;
+}
+
 int ngtcp2_crypto_update_key_cb(
     ngtcp2_conn *conn, uint8_t *rx_secret, uint8_t *tx_secret,
     ngtcp2_crypto_aead_ctx *rx_aead_ctx, uint8_t *rx_iv,
@@ -893,26 +1171,41 @@ static size_t crypto_generate_retry_token_aad(uint8_t *dest, uint32_t version,
 
 static const uint8_t retry_token_info_prefix[] = "retry_token";
 
-ngtcp2_ssize ngtcp2_crypto_generate_retry_token(
-    uint8_t *token, const uint8_t *secret, size_t secretlen, uint32_t version,
+/*
+ * crypto_token_nonce writes the nonce of length |ivlen| to |nonce|,
+ * which is |iv| XORed with the first |ivlen| bytes of |rand_data|.
+ */
+static void crypto_token_nonce(uint8_t *nonce, const uint8_t *iv, size_t ivlen,
+                               const uint8_t *rand_data) {
+  size_t i;
+
+  assert(ivlen <= NGTCP2_CRYPTO_TOKEN_RAND_DATALEN);
+
+  for (i = 0; i < ivlen; ++i) {
+    nonce[i] = iv[i] ^ rand_data[i];
+  }
+}
+
+/*
+ * crypto_seal_retry_token writes Retry token to |token| which is
+ * encrypted with |aead_ctx| and |nonce| of length |noncelen|.
+ * |rand_data| is appended to the token.
+ *
+ * This function returns the length of token if it succeeds, or -1.
+ */
+static ngtcp2_ssize crypto_seal_retry_token(
+    uint8_t *token, const ngtcp2_crypto_aead *aead,
+    const ngtcp2_crypto_aead_ctx *aead_ctx, const uint8_t *nonce,
+    size_t noncelen, const uint8_t *rand_data, uint32_t version,
     const ngtcp2_sockaddr *remote_addr, ngtcp2_socklen remote_addrlen,
     const ngtcp2_cid *retry_scid, const ngtcp2_cid *odcid, ngtcp2_tstamp ts) {
   uint8_t plaintext[NGTCP2_CRYPTO_MAX_RETRY_TOKENLEN];
-  uint8_t rand_data[NGTCP2_CRYPTO_TOKEN_RAND_DATALEN];
-  uint8_t key[32];
-  uint8_t iv[32];
-  size_t keylen;
-  size_t ivlen;
-  ngtcp2_crypto_aead aead;
-  ngtcp2_crypto_md md;
-  ngtcp2_crypto_aead_ctx aead_ctx;
   size_t plaintextlen;
   uint8_t aad[sizeof(version) + sizeof(ngtcp2_sockaddr_storage) +
               NGTCP2_MAX_CIDLEN];
   size_t aadlen;
   uint8_t *p = plaintext;
   ngtcp2_tstamp ts_be = ngtcp2_htonl64(ts);
-  int rv;
 
   memset(plaintext, 0, sizeof(plaintext));
 
@@ -924,6 +1217,88 @@ ngtcp2_ssize ngtcp2_crypto_generate_retry_token(
 
   plaintextlen = (size_t)(p - plaintext);
 
+  aadlen = crypto_generate_retry_token_aad(aad, version, remote_addr,
+                                           remote_addrlen, retry_scid);
+
+  p = token;
+  *p++ = NGTCP2_CRYPTO_TOKEN_MAGIC_RETRY;
+
+  if (ngtcp2_crypto_encrypt(p, aead, aead_ctx, plaintext, plaintextlen, nonce,
+                            noncelen, aad, aadlen) != 0) {
+    return -1;
+  }
+
+  p += plaintextlen + aead->max_overhead;
+  memcpy(p, rand_data, NGTCP2_CRYPTO_TOKEN_RAND_DATALEN);
+  p += NGTCP2_CRYPTO_TOKEN_RAND_DATALEN;
+
+  return p - token;
+}
+
+/*
+ * crypto_open_retry_token decrypts Retry token |token| of length
+ * NGTCP2_CRYPTO_MAX_RETRY_TOKENLEN with |aead_ctx| and |nonce| of
+ * length |noncelen|, and validates it.
+ *
+ * This function returns 0 if it succeeds, or -1.
+ */
+static int crypto_open_retry_token(
+    ngtcp2_cid *odcid, const uint8_t *token, const ngtcp2_crypto_aead *aead,
+    const ngtcp2_crypto_aead_ctx *aead_ctx, const uint8_t *nonce,
+    size_t noncelen, uint32_t version, const ngtcp2_sockaddr *remote_addr,
+    ngtcp2_socklen remote_addrlen, const ngtcp2_cid *dcid,
+    ngtcp2_duration timeout, ngtcp2_tstamp ts) {
+  uint8_t
+      plaintext[/* cid len = */ 1 + NGTCP2_MAX_CIDLEN + sizeof(ngtcp2_tstamp)];
+  uint8_t aad[sizeof(version) + sizeof(ngtcp2_sockaddr_storage) +
+              NGTCP2_MAX_CIDLEN];
+  size_t aadlen;
+  const uint8_t *ciphertext = token + 1;
+  size_t ciphertextlen =
+      NGTCP2_CRYPTO_MAX_RETRY_TOKENLEN - 1 - NGTCP2_CRYPTO_TOKEN_RAND_DATALEN;
+  size_t cil;
+  ngtcp2_tstamp gen_ts;
+
+  aadlen = crypto_generate_retry_token_aad(aad, version, remote_addr,
+                                           remote_addrlen, dcid);
+
+  if (ngtcp2_crypto_decrypt(plaintext, aead, aead_ctx, ciphertext,
+                            ciphertextlen, nonce, noncelen, aad,
+                            aadlen) != 0) {
+    return -1;
+  }
+
+  cil = plaintext[0];
+
+  assert(cil == 0 || (cil >= NGTCP2_MIN_CIDLEN && cil <= NGTCP2_MAX_CIDLEN));
+
+  memcpy(&gen_ts, plaintext + /* cid len = */ 1 + NGTCP2_MAX_CIDLEN,
+         sizeof(gen_ts));
+
+  gen_ts = ngtcp2_ntohl64(gen_ts);
+  if (gen_ts + timeout <= ts) {
+    return -1;
+  }
+
+  ngtcp2_cid_init(odcid, plaintext + /* cid len = */ 1, cil);
+
+  return 0;
+}
+
+ngtcp2_ssize ngtcp2_crypto_generate_retry_token(
+    uint8_t *token, const uint8_t *secret, size_t secretlen, uint32_t version,
+    const ngtcp2_sockaddr *remote_addr, ngtcp2_socklen remote_addrlen,
+    const ngtcp2_cid *retry_scid, const ngtcp2_cid *odcid, ngtcp2_tstamp ts) {
+  uint8_t rand_data[NGTCP2_CRYPTO_TOKEN_RAND_DATALEN];
+  uint8_t key[32];
+  uint8_t iv[32];
+  size_t keylen;
+  size_t ivlen;
+  ngtcp2_crypto_aead aead;
+  ngtcp2_crypto_md md;
+  ngtcp2_crypto_aead_ctx aead_ctx;
+  ngtcp2_ssize tokenlen;
+
   if (ngtcp2_crypto_random(rand_data, sizeof(rand_data)) != 0) {
     return -1;
   }
@@ -944,30 +1319,17 @@ ngtcp2_ssize ngtcp2_crypto_generate_retry_token(
     return -1;
   }
 
-  aadlen = crypto_generate_retry_token_aad(aad, version, remote_addr,
-                                           remote_addrlen, retry_scid);
-
-  p = token;
-  *p++ = NGTCP2_CRYPTO_TOKEN_MAGIC_RETRY;
-
   if (ngtcp2_crypto_aead_ctx_encrypt_init(&aead_ctx, &aead, key, ivlen) != 0) {
     return -1;
   }
 
-  rv = ngtcp2_crypto_encrypt(p, &aead, &aead_ctx, plaintext, plaintextlen, iv,
-                             ivlen, aad, aadlen);
+  tokenlen = crypto_seal_retry_token(token, &aead, &aead_ctx, iv, ivlen,
+                                     rand_data, version, remote_addr,
+                                     remote_addrlen, retry_scid, odcid, ts);
 
   ngtcp2_crypto_aead_ctx_free(&aead_ctx);
 
-  if (rv != 0) {
-    return -1;
-  }
-
-  p += plaintextlen + aead.max_overhead;
-  memcpy(p, rand_data, sizeof(rand_data));
-  p += sizeof(rand_data);
-
-  return p - token;
+  return tokenlen;
 }
 
 int ngtcp2_crypto_verify_retry_token(
@@ -975,8 +1337,6 @@ int ngtcp2_crypto_verify_retry_token(
     const uint8_t *secret, size_t secretlen, uint32_t version,
     const ngtcp2_sockaddr *remote_addr, ngtcp2_socklen remote_addrlen,
     const ngtcp2_cid *dcid, ngtcp2_duration timeout, ngtcp2_tstamp ts) {
-  uint8_t
-      plaintext[/* cid len = */ 1 + NGTCP2_MAX_CIDLEN + sizeof(ngtcp2_tstamp)];
   uint8_t key[32];
   uint8_t iv[32];
   size_t keylen;
@@ -984,15 +1344,8 @@ int ngtcp2_crypto_verify_retry_token(
   ngtcp2_crypto_aead_ctx aead_ctx;
   ngtcp2_crypto_aead aead;
   ngtcp2_crypto_md md;
-  uint8_t aad[sizeof(version) + sizeof(ngtcp2_sockaddr_storage) +
-              NGTCP2_MAX_CIDLEN];
-  size_t aadlen;
   const uint8_t *rand_data;
-  const uint8_t *ciphertext;
-  size_t ciphertextlen;
-  size_t cil;
   int rv;
-  ngtcp2_tstamp gen_ts;
 
   if (tokenlen != NGTCP2_CRYPTO_MAX_RETRY_TOKENLEN ||
       token[0] != NGTCP2_CRYPTO_TOKEN_MAGIC_RETRY) {
@@ -1000,8 +1353,6 @@ int ngtcp2_crypto_verify_retry_token(
   }
 
   rand_data = token + tokenlen - NGTCP2_CRYPTO_TOKEN_RAND_DATALEN;
-  ciphertext = token + 1;
-  ciphertextlen = tokenlen - 1 - NGTCP2_CRYPTO_TOKEN_RAND_DATALEN;
 
   ngtcp2_crypto_aead_aes_128_gcm(&aead);
   ngtcp2_crypto_md_sha256(&md);
@@ -1016,37 +1367,17 @@ int ngtcp2_crypto_verify_retry_token(
     return -1;
   }
 
-  aadlen = crypto_generate_retry_token_aad(aad, version, remote_addr,
-                                           remote_addrlen, dcid);
-
   if (ngtcp2_crypto_aead_ctx_decrypt_init(&aead_ctx, &aead, key, ivlen) != 0) {
     return -1;
   }
 
-  rv = ngtcp2_crypto_decrypt(plaintext, &aead, &aead_ctx, ciphertext,
-                             ciphertextlen, iv, ivlen, aad, aadlen);
+  rv = crypto_open_retry_token(odcid, token, &aead, &aead_ctx, iv, ivlen,
+                               version, remote_addr, remote_addrlen, dcid,
+                               timeout, ts);
 
   ngtcp2_crypto_aead_ctx_free(&aead_ctx);
 
-  if (rv != 0) {
-    return -1;
-  }
-
-  cil = plaintext[0];
-
-  assert(cil == 0 || (cil >= NGTCP2_MIN_CIDLEN && cil <= NGTCP2_MAX_CIDLEN));
-
-  memcpy(&gen_ts, plaintext + /* cid len = */ 1 + NGTCP2_MAX_CIDLEN,
-         sizeof(gen_ts));
-
-  gen_ts = ngtcp2_ntohl64(gen_ts);
-  if (gen_ts + timeout <= ts) {
-    return -1;
-  }
-
-  ngtcp2_cid_init(odcid, plaintext + /* cid len = */ 1, cil);
-
-  return 0;
+  return rv;
 }
 
 static size_t crypto_generate_regular_token_aad(uint8_t *dest,
@@ -1076,38 +1407,135 @@ static size_t crypto_generate_regular_token_aad(uint8_t *dest,
 
 static const uint8_t regular_token_info_prefix[] = "regular_token";
 
-ngtcp2_ssize ngtcp2_crypto_generate_regular_token(
-    uint8_t *token, const uint8_t *secret, size_t secretlen,
-    const ngtcp2_sockaddr *remote_addr, ngtcp2_socklen remote_addrlen,
+/* NGTCP2_CRYPTO_MAX_REGULAR_PLAINTEXTLEN is the maximum length of the
+   plaintext of a regular token: the timestamp and the opaque data. */
+#define NGTCP2_CRYPTO_MAX_REGULAR_PLAINTEXTLEN                                 \
+  (sizeof(ngtcp2_tstamp) + NGTCP2_CRYPTO_MAX_REGULAR_TOKEN_DATALEN)
+
+/*
+ * crypto_seal_regular_token writes a regular token to |token| which
+ * is encrypted with |aead_ctx| and |nonce| of length |noncelen|.
+ * The opaque |data| of length |datalen| is encrypted along with the
+ * timestamp.  |rand_data| is appended to the token.
+ *
+ * This function returns the length of token if it succeeds, or -1.
+ */
+static ngtcp2_ssize crypto_seal_regular_token(
+    uint8_t *token, const ngtcp2_crypto_aead *aead,
+    const ngtcp2_crypto_aead_ctx *aead_ctx, const uint8_t *nonce,
+    size_t noncelen, const uint8_t *rand_data,
+    const ngtcp2_sockaddr *remote_addr, const void *data, size_t datalen,
     ngtcp2_tstamp ts) {
-  uint8_t plaintext[sizeof(ngtcp2_tstamp)];
-  uint8_t rand_data[NGTCP2_CRYPTO_TOKEN_RAND_DATALEN];
-  uint8_t key[32];
-  uint8_t iv[32];
-  size_t keylen;
-  size_t ivlen;
-  ngtcp2_crypto_aead aead;
-  ngtcp2_crypto_md md;
-  ngtcp2_crypto_aead_ctx aead_ctx;
-  size_t plaintextlen;
+  uint8_t plaintext[NGTCP2_CRYPTO_MAX_REGULAR_PLAINTEXTLEN];
+  size_t plaintextlen = sizeof(ngtcp2_tstamp) + datalen;
   uint8_t aad[sizeof(ngtcp2_sockaddr_in6)];
   size_t aadlen;
-  uint8_t *p = plaintext;
+  uint8_t *p;
   ngtcp2_tstamp ts_be = ngtcp2_htonl64(ts);
-  int rv;
-  (void)remote_addrlen;
 
-  memcpy(p, &ts_be, sizeof(ts_be));
-  p += sizeof(ts_be);
-
-  plaintextlen = (size_t)(p - plaintext);
-
-  if (ngtcp2_crypto_random(rand_data, sizeof(rand_data)) != 0) {
+  if (datalen > NGTCP2_CRYPTO_MAX_REGULAR_TOKEN_DATALEN) {
     return -1;
   }
 
-  ngtcp2_crypto_aead_aes_128_gcm(&aead);
-  ngtcp2_crypto_md_sha256(&md);
+  memcpy(plaintext, &ts_be, sizeof(ts_be));
+  if (datalen) {
+    memcpy(plaintext + sizeof(ts_be), data, datalen);
+  }
+
+  aadlen = crypto_generate_regular_token_aad(aad, remote_addr);
+
+  p = token;
+  *p++ = NGTCP2_CRYPTO_TOKEN_MAGIC_REGULAR;
+
+  if (ngtcp2_crypto_encrypt(p, aead, aead_ctx, plaintext, plaintextlen, nonce,
+                            noncelen, aad, aadlen) != 0) {
+    return -1;
+  }
+
+  p += plaintextlen + aead->max_overhead;
+  memcpy(p, rand_data, NGTCP2_CRYPTO_TOKEN_RAND_DATALEN);
+  p += NGTCP2_CRYPTO_TOKEN_RAND_DATALEN;
+
+  return p - token;
+}
+
+/*
+ * crypto_open_regular_token decrypts a regular token |token| of
+ * length |tokenlen| with |aead_ctx| and |nonce| of length |noncelen|,
+ * and validates it.  |tokenlen| must be in the range
+ * [NGTCP2_CRYPTO_MAX_REGULAR_TOKENLEN,
+ * NGTCP2_CRYPTO_MAX_REGULAR_TOKEN2LEN].  The opaque data embedded in
+ * the token is copied to |data| of length |max_datalen|.
+ *
+ * This function returns the length of the opaque data if it
+ * succeeds, or -1.
+ */
+static ngtcp2_ssize crypto_open_regular_token(
+    void *data, size_t max_datalen, const uint8_t *token, size_t tokenlen,
+    const ngtcp2_crypto_aead *aead, const ngtcp2_crypto_aead_ctx *aead_ctx,
+    const uint8_t *nonce, size_t noncelen, const ngtcp2_sockaddr *remote_addr,
+    ngtcp2_duration timeout, ngtcp2_tstamp ts) {
+  uint8_t plaintext[NGTCP2_CRYPTO_MAX_REGULAR_PLAINTEXTLEN];
+  uint8_t aad[sizeof(ngtcp2_sockaddr_in6)];
+  size_t aadlen;
+  const uint8_t *ciphertext = token + 1;
+  size_t ciphertextlen = tokenlen - 1 - NGTCP2_CRYPTO_TOKEN_RAND_DATALEN;
+  size_t datalen = tokenlen - NGTCP2_CRYPTO_MAX_REGULAR_TOKENLEN;
+  ngtcp2_tstamp gen_ts;
+
+  assert(tokenlen >= NGTCP2_CRYPTO_MAX_REGULAR_TOKENLEN);
+  assert(tokenlen <= NGTCP2_CRYPTO_MAX_REGULAR_TOKEN2LEN);
+
+  if (datalen > max_datalen) {
+    return -1;
+  }
+
+  aadlen = crypto_generate_regular_token_aad(aad, remote_addr);
+
+  if (ngtcp2_crypto_decrypt(plaintext, aead, aead_ctx, ciphertext,
+                            ciphertextlen, nonce, noncelen, aad,
+                            aadlen) != 0) {
+    return -1;
+  }
+
+  memcpy(&gen_ts, plaintext, sizeof(gen_ts));
+
+  gen_ts = ngtcp2_ntohl64(gen_ts);
+  if (gen_ts + timeout <= ts) {
+    return -1;
+  }
+
+  if (datalen) {
+    memcpy(data, plaintext + sizeof(gen_ts), datalen);
+  }
+
+  return (ngtcp2_ssize)datalen;
+}
+
+/*
+ * crypto_generate_regular_token is the implementation of
+ * ngtcp2_crypto_generate_regular_token2.
+ */
+static ngtcp2_ssize crypto_generate_regular_token(
+    uint8_t *token, const uint8_t *secret, size_t secretlen,
+    const ngtcp2_sockaddr *remote_addr, const void *data, size_t datalen,
+    ngtcp2_tstamp ts) {
+  uint8_t rand_data[NGTCP2_CRYPTO_TOKEN_RAND_DATALEN];
+  uint8_t key[32];
+  uint8_t iv[32];
+  size_t keylen;
+  size_t ivlen;
+  ngtcp2_crypto_aead aead;
+  ngtcp2_crypto_md md;
+  ngtcp2_crypto_aead_ctx aead_ctx;
+  ngtcp2_ssize tokenlen;
+
+  if (ngtcp2_crypto_random(rand_data, sizeof(rand_data)) != 0) {
+    return -1;
+  }
+
+  ngtcp2_crypto_aead_aes_128_gcm(&aead);
+  ngtcp2_crypto_md_sha256(&md);
 
   keylen = ngtcp2_crypto_aead_keylen(&aead);
   ivlen = ngtcp2_crypto_aead_noncelen(&aead);
@@ -1122,38 +1550,49 @@ ngtcp2_ssize ngtcp2_crypto_generate_regular_token(
     return -1;
   }
 
-  aadlen = crypto_generate_regular_token_aad(aad, remote_addr);
-
-  p = token;
-  *p++ = NGTCP2_CRYPTO_TOKEN_MAGIC_REGULAR;
-
   if (ngtcp2_crypto_aead_ctx_encrypt_init(&aead_ctx, &aead, key, ivlen) != 0) {
     return -1;
   }
 
-  rv = ngtcp2_crypto_encrypt(p, &aead, &aead_ctx, plaintext, plaintextlen, iv,
-                             ivlen, aad, aadlen);
+  tokenlen = crypto_seal_regular_token(token, &aead, &aead_ctx, iv, ivlen,
+                                       rand_data, remote_addr, data, datalen,
+                                       ts);
 
   ngtcp2_crypto_aead_ctx_free(&aead_ctx);
 
-  if (rv != 0) {
-    return -1;
-  }
+  return tokenlen;
+}
 
-  p += plaintextlen + aead.max_overhead;
-  memcpy(p, rand_data, sizeof(rand_data));
-  p += sizeof(rand_data);
+ngtcp2_ssize ngtcp2_crypto_generate_regular_token(
+    uint8_t *token, const uint8_t *secret, size_t secretlen,
+    const ngtcp2_sockaddr *remote_addr, ngtcp2_socklen remote_addrlen,
+    ngtcp2_tstamp ts) {
+  (void)remote_addrlen;
 
-  return p - token;
+  return crypto_generate_regular_token(token, secret, secretlen, remote_addr,
+                                       NULL, 0, ts);
 }
 
-int ngtcp2_crypto_verify_regular_token(const uint8_t *token, size_t tokenlen,
-                                       const uint8_t *secret, size_t secretlen,
-                                       const ngtcp2_sockaddr *remote_addr,
-                                       ngtcp2_socklen remote_addrlen,
-                                       ngtcp2_duration timeout,
-                                       ngtcp2_tstamp ts) {
-  uint8_t plaintext[sizeof(ngtcp2_tstamp)];
+ngtcp2_ssize ngtcp2_crypto_generate_regular_token2(
+    uint8_t *token, const uint8_t *secret, size_t secretlen,
+    const ngtcp2_sockaddr *remote_addr, ngtcp2_socklen remote_addrlen,
+    const void *data, size_t datalen, ngtcp2_tstamp ts) {
+  (void)remote_addrlen;
+
+  return crypto_generate_regular_token(token, secret, secretlen, remote_addr,
+                                       data, datalen, ts);
+}
+
+/*
+ * crypto_verify_regular_token is the implementation of
+ * ngtcp2_crypto_verify_regular_token2.  The caller must validate
+ * |tokenlen| and the magic byte.
+ */
+static ngtcp2_ssize crypto_verify_regular_token(
+    void *data, size_t max_datalen, const uint8_t *token, size_t tokenlen,
+    const uint8_t *secret, size_t secretlen,
+    const ngtcp2_sockaddr *remote_addr, ngtcp2_duration timeout,
+    ngtcp2_tstamp ts) {
   uint8_t key[32];
   uint8_t iv[32];
   size_t keylen;
@@ -1161,23 +1600,10 @@ int ngtcp2_crypto_verify_regular_token(const uint8_t *token, size_t tokenlen,
   ngtcp2_crypto_aead_ctx aead_ctx;
   ngtcp2_crypto_aead aead;
   ngtcp2_crypto_md md;
-  uint8_t aad[sizeof(ngtcp2_sockaddr_in6)];
-  size_t aadlen;
   const uint8_t *rand_data;
-  const uint8_t *ciphertext;
-  size_t ciphertextlen;
-  int rv;
-  ngtcp2_tstamp gen_ts;
-  (void)remote_addrlen;
-
-  if (tokenlen != NGTCP2_CRYPTO_MAX_REGULAR_TOKENLEN ||
-      token[0] != NGTCP2_CRYPTO_TOKEN_MAGIC_REGULAR) {
-    return -1;
-  }
+  ngtcp2_ssize datalen;
 
   rand_data = token + tokenlen - NGTCP2_CRYPTO_TOKEN_RAND_DATALEN;
-  ciphertext = token + 1;
-  ciphertextlen = tokenlen - 1 - NGTCP2_CRYPTO_TOKEN_RAND_DATALEN;
 
   ngtcp2_crypto_aead_aes_128_gcm(&aead);
   ngtcp2_crypto_md_sha256(&md);
@@ -1192,41 +1618,483 @@ int ngtcp2_crypto_verify_regular_token(const uint8_t *token, size_t tokenlen,
     return -1;
   }
 
-  aadlen = crypto_generate_regular_token_aad(aad, remote_addr);
-
   if (ngtcp2_crypto_aead_ctx_decrypt_init(&aead_ctx, &aead, key, ivlen) != 0) {
     return -1;
   }
 
-  rv = ngtcp2_crypto_decrypt(plaintext, &aead, &aead_ctx, ciphertext,
-                             ciphertextlen, iv, ivlen, aad, aadlen);
+  datalen = crypto_open_regular_token(data, max_datalen, token, tokenlen,
+                                      &aead, &aead_ctx, iv, ivlen, remote_addr,
+                                      timeout, ts);
 
   ngtcp2_crypto_aead_ctx_free(&aead_ctx);
 
-  if (rv != 0) {
+  return datalen;
+}
+
+int ngtcp2_crypto_verify_regular_token(const uint8_t *token, size_t tokenlen,
+                                       const uint8_t *secret, size_t secretlen,
+                                       const ngtcp2_sockaddr *remote_addr,
+                                       ngtcp2_socklen remote_addrlen,
+                                       ngtcp2_duration timeout,
+                                       ngtcp2_tstamp ts) {
+  (void)remote_addrlen;
+
+  if (tokenlen != NGTCP2_CRYPTO_MAX_REGULAR_TOKENLEN ||
+      token[0] != NGTCP2_CRYPTO_TOKEN_MAGIC_REGULAR) {
     return -1;
   }
 
-  memcpy(&gen_ts, plaintext, sizeof(gen_ts));
+  if (crypto_verify_regular_token(NULL, 0, token, tokenlen, secret,
+                                  secretlen, remote_addr, timeout, ts) < 0) {
+    return -1;
+  }
 
-  gen_ts = ngtcp2_ntohl64(gen_ts);
-  if (gen_ts + timeout <= ts) {
+  return 0;
+}
+
+ngtcp2_ssize ngtcp2_crypto_verify_regular_token2(
+    void *data, size_t max_datalen, const uint8_t *token, size_t tokenlen,
+    const uint8_t *secret, size_t secretlen,
+    const ngtcp2_sockaddr *remote_addr, ngtcp2_socklen remote_addrlen,
+    ngtcp2_duration timeout, ngtcp2_tstamp ts) {
+  (void)remote_addrlen;
+
+  if (tokenlen < NGTCP2_CRYPTO_MAX_REGULAR_TOKENLEN ||
+      tokenlen > NGTCP2_CRYPTO_MAX_REGULAR_TOKEN2LEN ||
+      token[0] != NGTCP2_CRYPTO_TOKEN_MAGIC_REGULAR) {
+    return -1;
+  }
+
+  return crypto_verify_regular_token(data, max_datalen, token, tokenlen,
+                                     secret, secretlen, remote_addr, timeout,
+                                     ts);
+}
+
+/*
+ * crypto_token_ctx_derive derives the key and IV for the tokens
+ * whose info prefix is |info_prefix| of length |info_prefixlen|, and
+ * initializes |encrypt_ctx| and |decrypt_ctx| with the key.
+ */
+static int crypto_token_ctx_derive(ngtcp2_crypto_token_ctx *ctx,
+                                   ngtcp2_crypto_aead_ctx *encrypt_ctx,
+                                   ngtcp2_crypto_aead_ctx *decrypt_ctx,
+                                   uint8_t *iv, const uint8_t *secret,
+                                   size_t secretlen, const uint8_t *info_prefix,
+                                   size_t info_prefixlen) {
+  static const uint8_t salt[] = "token_ctx";
+  uint8_t key[32];
+  size_t keylen = ngtcp2_crypto_aead_keylen(&ctx->aead);
+  size_t ivlen = ngtcp2_crypto_aead_noncelen(&ctx->aead);
+  ngtcp2_crypto_md md;
+
+  assert(sizeof(key) >= keylen);
+  assert(NGTCP2_CRYPTO_TOKEN_IVLEN == ivlen);
+
+  ngtcp2_crypto_md_sha256(&md);
+
+  if (crypto_derive_token_key(key, keylen, iv, ivlen, &md, secret, secretlen,
+                              salt, sizeof(salt) - 1, info_prefix,
+                              info_prefixlen) != 0) {
+    return -1;
+  }
+
+  if (ngtcp2_crypto_aead_ctx_encrypt_init(encrypt_ctx, &ctx->aead, key,
+                                          ivlen) != 0 ||
+      ngtcp2_crypto_aead_ctx_decrypt_init(decrypt_ctx, &ctx->aead, key,
+                                          ivlen) != 0) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int ngtcp2_crypto_token_ctx_init(ngtcp2_crypto_token_ctx *ctx,
+                                 const uint8_t *secret, size_t secretlen) {
+  memset(ctx, 0, sizeof(*ctx));
+
+  ngtcp2_crypto_aead_aes_128_gcm(&ctx->aead);
+
+  if (crypto_token_ctx_derive(ctx, &ctx->retry_encrypt_ctx,
+                              &ctx->retry_decrypt_ctx, ctx->retry_iv, secret,
+                              secretlen, retry_token_info_prefix,
+                              sizeof(retry_token_info_prefix) - 1) != 0 ||
+      crypto_token_ctx_derive(ctx, &ctx->regular_encrypt_ctx,
+                              &ctx->regular_decrypt_ctx, ctx->regular_iv,
+                              secret, secretlen, regular_token_info_prefix,
+                              sizeof(regular_token_info_prefix) - 1) != 0) {
+    ngtcp2_crypto_token_ctx_free(ctx);
+    return -1;
+  }
+
+  return 0;
+}
+
+void ngtcp2_crypto_token_ctx_free(ngtcp2_crypto_token_ctx *ctx) {
+  ngtcp2_crypto_aead_ctx_free(&ctx->retry_encrypt_ctx);
+  ngtcp2_crypto_aead_ctx_free(&ctx->retry_decrypt_ctx);
+  ngtcp2_crypto_aead_ctx_free(&ctx->regular_encrypt_ctx);
+  ngtcp2_crypto_aead_ctx_free(&ctx->regular_decrypt_ctx);
+
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+ngtcp2_ssize ngtcp2_crypto_token_ctx_generate_retry_token(
+    ngtcp2_crypto_token_ctx *ctx, uint8_t *token, uint32_t version,
+    const ngtcp2_sockaddr *remote_addr, ngtcp2_socklen remote_addrlen,
+    const ngtcp2_cid *retry_scid, const ngtcp2_cid *odcid, ngtcp2_tstamp ts) {
+  uint8_t rand_data[NGTCP2_CRYPTO_TOKEN_RAND_DATALEN];
+  uint8_t nonce[NGTCP2_CRYPTO_TOKEN_IVLEN];
+
+  if (ngtcp2_crypto_random(rand_data, sizeof(rand_data)) != 0) {
+    return -1;
+  }
+
+  crypto_token_nonce(nonce, ctx->retry_iv, sizeof(nonce), rand_data);
+
+  return crypto_seal_retry_token(token, &ctx->aead, &ctx->retry_encrypt_ctx,
+                                 nonce, sizeof(nonce), rand_data, version,
+                                 remote_addr, remote_addrlen, retry_scid, odcid,
+                                 ts);
+}
+
+int ngtcp2_crypto_token_ctx_verify_retry_token(
+    ngtcp2_crypto_token_ctx *ctx, ngtcp2_cid *odcid, const uint8_t *token,
+    size_t tokenlen, uint32_t version, const ngtcp2_sockaddr *remote_addr,
+    ngtcp2_socklen remote_addrlen, const ngtcp2_cid *dcid,
+    ngtcp2_duration timeout, ngtcp2_tstamp ts) {
+  uint8_t nonce[NGTCP2_CRYPTO_TOKEN_IVLEN];
+
+  if (tokenlen != NGTCP2_CRYPTO_MAX_RETRY_TOKENLEN ||
+      token[0] != NGTCP2_CRYPTO_TOKEN_MAGIC_RETRY) {
+    return -1;
+  }
+
+  crypto_token_nonce(nonce, ctx->retry_iv, sizeof(nonce),
+                     token + tokenlen - NGTCP2_CRYPTO_TOKEN_RAND_DATALEN);
+
+  return crypto_open_retry_token(odcid, token, &ctx->aead,
+                                 &ctx->retry_decrypt_ctx, nonce, sizeof(nonce),
+                                 version, remote_addr, remote_addrlen, dcid,
+                                 timeout, ts);
+}
+
+ngtcp2_ssize ngtcp2_crypto_token_ctx_generate_regular_token(
+    ngtcp2_crypto_token_ctx *ctx, uint8_t *token,
+    const ngtcp2_sockaddr *remote_addr, ngtcp2_socklen remote_addrlen,
+    ngtcp2_tstamp ts) {
+  return ngtcp2_crypto_token_ctx_generate_regular_token2(
+      ctx, token, remote_addr, remote_addrlen, NULL, 0, ts);
+}
+
+ngtcp2_ssize ngtcp2_crypto_token_ctx_generate_regular_token2(
+    ngtcp2_crypto_token_ctx *ctx, uint8_t *token,
+    const ngtcp2_sockaddr *remote_addr, ngtcp2_socklen remote_addrlen,
+    const void *data, size_t datalen, ngtcp2_tstamp ts) {
+  uint8_t rand_data[NGTCP2_CRYPTO_TOKEN_RAND_DATALEN];
+  uint8_t nonce[NGTCP2_CRYPTO_TOKEN_IVLEN];
+  (void)remote_addrlen;
+
+  if (ngtcp2_crypto_random(rand_data, sizeof(rand_data)) != 0) {
+    return -1;
+  }
+
+  crypto_token_nonce(nonce, ctx->regular_iv, sizeof(nonce), rand_data);
+
+  return crypto_seal_regular_token(
+      token, &ctx->aead, &ctx->regular_encrypt_ctx, nonce, sizeof(nonce),
+      rand_data, remote_addr, data, datalen, ts);
+}
+
+int ngtcp2_crypto_token_ctx_verify_regular_token(
+    ngtcp2_crypto_token_ctx *ctx, const uint8_t *token, size_t tokenlen,
+    const ngtcp2_sockaddr *remote_addr, ngtcp2_socklen remote_addrlen,
+    ngtcp2_duration timeout, ngtcp2_tstamp ts) {
+  if (tokenlen != NGTCP2_CRYPTO_MAX_REGULAR_TOKENLEN) {
+    return -1;
+  }
+
+  if (ngtcp2_crypto_token_ctx_verify_regular_token2(
+          ctx, NULL, 0, token, tokenlen, remote_addr, remote_addrlen, timeout,
+          ts) < 0) {
     return -1;
   }
 
   return 0;
 }
 
+ngtcp2_ssize ngtcp2_crypto_token_ctx_verify_regular_token2(
+    ngtcp2_crypto_token_ctx *ctx, void *data, size_t max_datalen,
+    const uint8_t *token, size_t tokenlen, const ngtcp2_sockaddr *remote_addr,
+    ngtcp2_socklen remote_addrlen, ngtcp2_duration timeout, ngtcp2_tstamp ts) {
+  uint8_t nonce[NGTCP2_CRYPTO_TOKEN_IVLEN];
+  (void)remote_addrlen;
+
+  if (tokenlen < NGTCP2_CRYPTO_MAX_REGULAR_TOKENLEN ||
+      tokenlen > NGTCP2_CRYPTO_MAX_REGULAR_TOKEN2LEN ||
+      token[0] != NGTCP2_CRYPTO_TOKEN_MAGIC_REGULAR) {
+    return -1;
+  }
+
+  crypto_token_nonce(nonce, ctx->regular_iv, sizeof(nonce),
+                     token + tokenlen - NGTCP2_CRYPTO_TOKEN_RAND_DATALEN);
+
+  return crypto_open_regular_token(data, max_datalen, token, tokenlen,
+                                   &ctx->aead, &ctx->regular_decrypt_ctx,
+                                   nonce, sizeof(nonce), remote_addr, timeout,
+                                   ts);
+}
+
+void ngtcp2_crypto_initial_key_cache_init(
+    ngtcp2_crypto_initial_key_cache *cache) {
+  memset(cache, 0, sizeof(*cache));
+}
+
+int ngtcp2_crypto_cid_ctx_init(ngtcp2_crypto_cid_ctx *ctx,
+                               const uint8_t *secret, size_t secretlen) {
+  static const uint8_t salt[] = "cid_ctx";
+  static const uint8_t info_prefix[] = "cid";
+  uint8_t key[32];
+  size_t keylen, ivlen;
+  ngtcp2_crypto_md md;
+
+  memset(ctx, 0, sizeof(*ctx));
+
+  ngtcp2_crypto_aead_aes_128_gcm(&ctx->aead);
+
+  keylen = ngtcp2_crypto_aead_keylen(&ctx->aead);
+  ivlen = ngtcp2_crypto_aead_noncelen(&ctx->aead);
+
+  assert(sizeof(key) >= keylen);
+  assert(sizeof(ctx->iv) == ivlen);
+
+  ngtcp2_crypto_md_sha256(&md);
+
+  if (crypto_derive_token_key(key, keylen, ctx->iv, ivlen, &md, secret,
+                              secretlen, salt, sizeof(salt) - 1, info_prefix,
+                              sizeof(info_prefix) - 1) != 0 ||
+      ngtcp2_crypto_aead_ctx_encrypt_init(&ctx->aead_ctx, &ctx->aead, key,
+                                          ivlen) != 0) {
+    ngtcp2_crypto_cid_ctx_free(ctx);
+    return -1;
+  }
+
+  return 0;
+}
+
+void ngtcp2_crypto_cid_ctx_free(ngtcp2_crypto_cid_ctx *ctx) {
+  ngtcp2_crypto_aead_ctx_free(&ctx->aead_ctx);
+
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+/*
+ * crypto_cid_round XORs the output of the round function of round
+ * |round| over |in| of length |inlen| into |out| of length |outlen|.
+ * |total| is the length of the encrypted part of Connection ID, and
+ * it separates the rounds for the different lengths.  The round
+ * function is the AES-GCM keystream under the nonce which encodes the
+ * round, |total|, and |in|.
+ */
+static int crypto_cid_round(ngtcp2_crypto_cid_ctx *ctx, uint8_t *out,
+                            size_t outlen, const uint8_t *in, size_t inlen,
+                            size_t round, size_t total) {
+  static const uint8_t zeros[NGTCP2_MAX_CIDLEN] = {0};
+  uint8_t nonce[NGTCP2_CRYPTO_TOKEN_IVLEN];
+  uint8_t ks[NGTCP2_MAX_CIDLEN + 16];
+  size_t i;
+
+  assert(inlen < sizeof(nonce));
+  assert(outlen + ctx->aead.max_overhead <= sizeof(ks));
+
+  memset(nonce, 0, sizeof(nonce));
+  nonce[0] = (uint8_t)((round << 5) | total);
+  memcpy(nonce + 1, in, inlen);
+
+  for (i = 0; i < sizeof(nonce); ++i) {
+    nonce[i] ^= ctx->iv[i];
+  }
+
+  if (ngtcp2_crypto_encrypt(ks, &ctx->aead, &ctx->aead_ctx, zeros, outlen,
+                            nonce, sizeof(nonce), NULL, 0) != 0) {
+    return -1;
+  }
+
+  for (i = 0; i < outlen; ++i) {
+    out[i] ^= ks[i];
+  }
+
+  return 0;
+}
+
+/*
+ * crypto_cid_feistel runs 4 rounds of unbalanced Feistel network over
+ * |data| of length |datalen| in place.  If |decrypt| is nonzero, the
+ * rounds are applied in the reverse order.
+ */
+static int crypto_cid_feistel(ngtcp2_crypto_cid_ctx *ctx, uint8_t *data,
+                              size_t datalen, int decrypt) {
+  size_t leftlen = datalen / 2;
+  size_t rightlen = datalen - leftlen;
+  uint8_t *left = data, *right = data + leftlen;
+  size_t i, round;
+  int rv;
+
+  for (i = 0; i < 4; ++i) {
+    round = decrypt ? 3 - i : i;
+
+    if (round & 1) {
+      rv = crypto_cid_round(ctx, left, leftlen, right, rightlen, round,
+                            datalen);
+    } else {
+      rv = crypto_cid_round(ctx, right, rightlen, left, leftlen, round,
+                            datalen);
+    }
+
+    if (rv != 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int ngtcp2_crypto_cid_ctx_encrypt_cid(ngtcp2_crypto_cid_ctx *ctx,
+                                      ngtcp2_cid *cid,
+                                      const uint8_t *plaintext,
+                                      size_t plaintextlen) {
+  if (plaintextlen < NGTCP2_CRYPTO_MIN_ENCRYPTED_CIDLEN ||
+      plaintextlen > NGTCP2_MAX_CIDLEN) {
+    return -1;
+  }
+
+  ngtcp2_cid_init(cid, plaintext, plaintextlen);
+
+  return crypto_cid_feistel(ctx, cid->data + 1, cid->datalen - 1, 0);
+}
+
+int ngtcp2_crypto_cid_ctx_decrypt_cid(ngtcp2_crypto_cid_ctx *ctx,
+                                      uint8_t *plaintext,
+                                      const ngtcp2_cid *cid) {
+  if (cid->datalen < NGTCP2_CRYPTO_MIN_ENCRYPTED_CIDLEN ||
+      cid->datalen > NGTCP2_MAX_CIDLEN) {
+    return -1;
+  }
+
+  memcpy(plaintext, cid->data, cid->datalen);
+
+  return crypto_cid_feistel(ctx, plaintext + 1, cid->datalen - 1, 1);
+}
+
+/*
+ * crypto_quic_lb_config_valid returns nonzero if |config| is valid.
+ */
+static int crypto_quic_lb_config_valid(
+    const ngtcp2_crypto_quic_lb_config *config) {
+  return config->config_id <= NGTCP2_CRYPTO_QUIC_LB_MAX_CONFIG_ID &&
+         config->server_idlen >= 1 &&
+         config->server_idlen <= NGTCP2_CRYPTO_QUIC_LB_MAX_SERVER_IDLEN &&
+         config->noncelen >= NGTCP2_CRYPTO_QUIC_LB_MIN_NONCELEN &&
+         1 + config->server_idlen + config->noncelen <= NGTCP2_MAX_CIDLEN;
+}
+
+int ngtcp2_crypto_quic_lb_generate_cid(
+    ngtcp2_cid *cid, const ngtcp2_crypto_quic_lb_config *config,
+    const uint8_t *nonce) {
+  uint8_t plaintext[NGTCP2_MAX_CIDLEN];
+  size_t cidlen;
+
+  if (!crypto_quic_lb_config_valid(config)) {
+    return -1;
+  }
+
+  cidlen = 1 + config->server_idlen + config->noncelen;
+
+  plaintext[0] = (uint8_t)((config->config_id << 5) | (cidlen - 1));
+  memcpy(plaintext + 1, config->server_id, config->server_idlen);
+  memcpy(plaintext + 1 + config->server_idlen, nonce, config->noncelen);
+
+  if (!config->cid_ctx) {
+    ngtcp2_cid_init(cid, plaintext, cidlen);
+
+    return 0;
+  }
+
+  return ngtcp2_crypto_cid_ctx_encrypt_cid(config->cid_ctx, cid, plaintext,
+                                           cidlen);
+}
+
+int ngtcp2_crypto_quic_lb_decode_server_id(
+    uint8_t *server_id, const ngtcp2_crypto_quic_lb_config *config,
+    const ngtcp2_cid *cid) {
+  uint8_t plaintext[NGTCP2_MAX_CIDLEN];
+  const uint8_t *p;
+  size_t cidlen;
+
+  if (!crypto_quic_lb_config_valid(config)) {
+    return -1;
+  }
+
+  cidlen = 1 + config->server_idlen + config->noncelen;
+
+  if (cid->datalen != cidlen ||
+      cid->data[0] != (uint8_t)((config->config_id << 5) | (cidlen - 1))) {
+    return -1;
+  }
+
+  if (config->cid_ctx) {
+    if (ngtcp2_crypto_cid_ctx_decrypt_cid(config->cid_ctx, plaintext, cid) !=
+        0) {
+      return -1;
+    }
+
+    p = plaintext;
+  } else {
+    p = cid->data;
+  }
+
+  memcpy(server_id, p + 1, config->server_idlen);
+
+  return 0;
+}
+
+/*
+ * crypto_initial_key_cache_find returns the entry for |version| and
+ * |dcid| in |cache|, or NULL.
+ */
+static const ngtcp2_crypto_initial_key_cache_entry *
+crypto_initial_key_cache_find(const ngtcp2_crypto_initial_key_cache *cache,
+                              uint32_t version, const ngtcp2_cid *dcid) {
+  const ngtcp2_crypto_initial_key_cache_entry *ent;
+  size_t i;
+
+  for (i = 0; i < NGTCP2_CRYPTO_INITIAL_KEY_CACHE_SIZE; ++i) {
+    ent = &cache->ents[i];
+
+    if (ent->version == version && ngtcp2_cid_eq(&ent->dcid, dcid)) {
+      return ent;
+    }
+  }
+
+  return NULL;
+}
+
 ngtcp2_ssize ngtcp2_crypto_write_connection_close(
     uint8_t *dest, size_t destlen, uint32_t version, const ngtcp2_cid *dcid,
     const ngtcp2_cid *scid, uint64_t error_code, const uint8_t *reason,
     size_t reasonlen) {
+  return ngtcp2_crypto_write_connection_close_cached(
+      dest, destlen, version, dcid, scid, error_code, reason, reasonlen, NULL);
+}
+
+ngtcp2_ssize ngtcp2_crypto_write_connection_close_cached(
+    uint8_t *dest, size_t destlen, uint32_t version, const ngtcp2_cid *dcid,
+    const ngtcp2_cid *scid, uint64_t error_code, const uint8_t *reason,
+    size_t reasonlen, ngtcp2_crypto_initial_key_cache *cache) {
   uint8_t rx_secret[NGTCP2_CRYPTO_INITIAL_SECRETLEN];
   uint8_t tx_secret[NGTCP2_CRYPTO_INITIAL_SECRETLEN];
   uint8_t initial_secret[NGTCP2_CRYPTO_INITIAL_SECRETLEN];
-  uint8_t tx_key[NGTCP2_CRYPTO_INITIAL_KEYLEN];
-  uint8_t tx_iv[NGTCP2_CRYPTO_INITIAL_IVLEN];
-  uint8_t tx_hp_key[NGTCP2_CRYPTO_INITIAL_KEYLEN];
+  ngtcp2_crypto_initial_key_cache_entry entbuf;
+  const ngtcp2_crypto_initial_key_cache_entry *ent = NULL;
   ngtcp2_crypto_ctx ctx;
   ngtcp2_ssize spktlen;
   ngtcp2_crypto_aead_ctx aead_ctx = {0};
@@ -1234,32 +2102,49 @@ ngtcp2_ssize ngtcp2_crypto_write_connection_close(
 
   ngtcp2_crypto_ctx_initial(&ctx);
 
-  if (ngtcp2_crypto_derive_initial_secrets(version, rx_secret, tx_secret,
-                                           initial_secret, scid,
-                                           NGTCP2_CRYPTO_SIDE_SERVER) != 0) {
-    return -1;
+  if (cache) {
+    ent = crypto_initial_key_cache_find(cache, version, scid);
   }
 
-  if (ngtcp2_crypto_derive_packet_protection_key(
-          tx_key, tx_iv, tx_hp_key, version, &ctx.aead, &ctx.md, tx_secret,
-          NGTCP2_CRYPTO_INITIAL_SECRETLEN) != 0) {
-    return -1;
+  if (!ent) {
+    if (ngtcp2_crypto_derive_initial_secrets(version, rx_secret, tx_secret,
+                                             initial_secret, scid,
+                                             NGTCP2_CRYPTO_SIDE_SERVER) != 0) {
+      return -1;
+    }
+
+    if (ngtcp2_crypto_derive_packet_protection_key(
+            entbuf.tx_key, entbuf.tx_iv, entbuf.tx_hp_key, version, &ctx.aead,
+            &ctx.md, tx_secret, NGTCP2_CRYPTO_INITIAL_SECRETLEN) != 0) {
+      return -1;
+    }
+
+    entbuf.version = version;
+    entbuf.dcid = *scid;
+
+    if (cache) {
+      cache->ents[cache->next] = entbuf;
+      cache->next = (cache->next + 1) % NGTCP2_CRYPTO_INITIAL_KEY_CACHE_SIZE;
+    }
+
+    ent = &entbuf;
   }
 
-  if (ngtcp2_crypto_aead_ctx_encrypt_init(&aead_ctx, &ctx.aead, tx_key,
+  if (ngtcp2_crypto_aead_ctx_encrypt_init(&aead_ctx, &ctx.aead, ent->tx_key,
                                           NGTCP2_CRYPTO_INITIAL_IVLEN) != 0) {
     spktlen = -1;
     goto end;
   }
 
-  if (ngtcp2_crypto_cipher_ctx_encrypt_init(&hp_ctx, &ctx.hp, tx_hp_key) != 0) {
+  if (ngtcp2_crypto_cipher_ctx_encrypt_init(&hp_ctx, &ctx.hp,
+                                            ent->tx_hp_key) != 0) {
     spktlen = -1;
     goto end;
   }
 
   spktlen = ngtcp2_pkt_write_connection_close(
       dest, destlen, version, dcid, scid, error_code, reason, reasonlen,
-      ngtcp2_crypto_encrypt_cb, &ctx.aead, &aead_ctx, tx_iv,
+      ngtcp2_crypto_encrypt_cb, &ctx.aead, &aead_ctx, ent->tx_iv,
       ngtcp2_crypto_hp_mask_cb, &ctx.hp, &hp_ctx);
   if (spktlen < 0) {
     spktlen = -1;
@@ -1316,6 +2201,61 @@ ngtcp2_ssize ngtcp2_crypto_write_retry(uint8_t *dest, size_t destlen,
   return spktlen;
 }
 
+int ngtcp2_crypto_retry_ctx_init(ngtcp2_crypto_retry_ctx *ctx) {
+  memset(ctx, 0, sizeof(*ctx));
+
+  ngtcp2_crypto_aead_retry(&ctx->aead);
+
+  if (ngtcp2_crypto_aead_ctx_encrypt_init(
+          &ctx->v1_ctx, &ctx->aead, (const uint8_t *)NGTCP2_RETRY_KEY_V1,
+          sizeof(NGTCP2_RETRY_NONCE_V1) - 1) != 0 ||
+      ngtcp2_crypto_aead_ctx_encrypt_init(
+          &ctx->v2_draft_ctx, &ctx->aead,
+          (const uint8_t *)NGTCP2_RETRY_KEY_V2_DRAFT,
+          sizeof(NGTCP2_RETRY_NONCE_V2_DRAFT) - 1) != 0) {
+    ngtcp2_crypto_retry_ctx_free(ctx);
+    return -1;
+  }
+
+  return 0;
+}
+
+void ngtcp2_crypto_retry_ctx_free(ngtcp2_crypto_retry_ctx *ctx) {
+  ngtcp2_crypto_aead_ctx_free(&ctx->v1_ctx);
+  ngtcp2_crypto_aead_ctx_free(&ctx->v2_draft_ctx);
+
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+ngtcp2_ssize ngtcp2_crypto_retry_ctx_write_retry(
+    ngtcp2_crypto_retry_ctx *ctx, uint8_t *dest, size_t destlen,
+    uint32_t version, const ngtcp2_cid *dcid, const ngtcp2_cid *scid,
+    const ngtcp2_cid *odcid, const uint8_t *token, size_t tokenlen) {
+  ngtcp2_crypto_aead_ctx *aead_ctx;
+  ngtcp2_ssize spktlen;
+
+  switch (version) {
+  case NGTCP2_PROTO_VER_V1:
+    aead_ctx = &ctx->v1_ctx;
+    break;
+  case NGTCP2_PROTO_VER_V2_DRAFT:
+    aead_ctx = &ctx->v2_draft_ctx;
+    break;
+  default:
+    return ngtcp2_crypto_write_retry(dest, destlen, version, dcid, scid,
+                                     odcid, token, tokenlen);
+  }
+
+  spktlen = ngtcp2_pkt_write_retry(dest, destlen, version, dcid, scid, odcid,
+                                   token, tokenlen, ngtcp2_crypto_encrypt_cb,
+                                   &ctx->aead, aead_ctx);
+  if (spktlen < 0) {
+    return -1;
+  }
+
+  return spktlen;
+}
+
 int ngtcp2_crypto_client_initial_cb(ngtcp2_conn *conn, void *user_data) {
   const ngtcp2_cid *dcid = ngtcp2_conn_get_dcid(conn);
   void *tls = ngtcp2_conn_get_tls_native_handle(conn);
@@ -72,6 +72,12 @@
 #define NGTCP2_CRYPTO_MAX_DECRYPTION_FAILURE_CHACHA20_POLY1305 (1ULL << 36)
 #define NGTCP2_CRYPTO_MAX_DECRYPTION_FAILURE_AES_CCM (2965820ULL)
 
+/* TLSv1.3 cipher suites which QUIC uses */
+#define NGTCP2_CRYPTO_TLS_AES_128_GCM_SHA256 0x1301u
+#define NGTCP2_CRYPTO_TLS_AES_256_GCM_SHA384 0x1302u
+#define NGTCP2_CRYPTO_TLS_CHACHA20_POLY1305_SHA256 0x1303u
+#define NGTCP2_CRYPTO_TLS_AES_128_CCM_SHA256 0x1304u
+
 /**
  * @function
  *
@@ -309,6 +315,38 @@ int ngtcp2_crypto_derive_and_install_vneg_initial_key(
     uint8_t *tx_key, uint8_t *tx_iv, uint8_t *tx_hp, uint32_t version,
     const ngtcp2_cid *client_dcid);
 
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_aead_ctx_encrypt_reinit` replaces the key of
+ * |aead_ctx|, which was initialized by
+ * `ngtcp2_crypto_aead_ctx_encrypt_init` with |aead|, with |key|.  It
+ * reuses the underlying native context object if the backend
+ * supports it.
+ *
+ * This function returns 0 if it succeeds, or -1.  If it fails,
+ * |aead_ctx| has been freed, and its native_handle is set to NULL.
+ */
+int ngtcp2_crypto_aead_ctx_encrypt_reinit(ngtcp2_crypto_aead_ctx *aead_ctx,
+                                          const ngtcp2_crypto_aead *aead,
+                                          const uint8_t *key, size_t noncelen);
+
+/**
+ * @function
+ *
+ * `ngtcp2_crypto_aead_ctx_decrypt_reinit` replaces the key of
+ * |aead_ctx|, which was initialized by
+ * `ngtcp2_crypto_aead_ctx_decrypt_init` with |aead|, with |key|.  It
+ * reuses the underlying native context object if the backend
+ * supports it.
+ *
+ * This function returns 0 if it succeeds, or -1.  If it fails,
+ * |aead_ctx| has been freed, and its native_handle is set to NULL.
+ */
+int ngtcp2_crypto_aead_ctx_decrypt_reinit(ngtcp2_crypto_aead_ctx *aead_ctx,
+                                          const ngtcp2_crypto_aead *aead,
+                                          const uint8_t *key, size_t noncelen);
+
 /**
  * @function
  *
@@ -347,4 +385,18 @@ ngtcp2_crypto_aead *ngtcp2_crypto_aead_aes_128_gcm(ngtcp2_crypto_aead *aead);
  */
 int ngtcp2_crypto_random(uint8_t *data, size_t datalen);
 
+/*
+ * `ngtcp2_crypto_encrypt_vec_gather` is the implementation of
+ * `ngtcp2_crypto_encrypt_vec` for the backends which can only
+ * encrypt contiguous plaintext.  It copies the vectors which are not
+ * in |dest| into their place, and then encrypts |dest| in place.
+ *
+ * This function returns 0 if it succeeds, or -1.
+ */
+int ngtcp2_crypto_encrypt_vec_gather(
+    uint8_t *dest, const ngtcp2_crypto_aead *aead,
+    const ngtcp2_crypto_aead_ctx *aead_ctx, const ngtcp2_vec *plaintext,
+    size_t plaintextcnt, const uint8_t *nonce, size_t noncelen,
+    const uint8_t *aad, size_t aadlen);
+
 #endif /* NGTCP2_SHARED_H */
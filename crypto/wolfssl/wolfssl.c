@@ -73,9 +73,8 @@ ngtcp2_crypto_aead *ngtcp2_crypto_aead_retry(ngtcp2_crypto_aead *aead) {
   return ngtcp2_crypto_aead_init(aead, (void *)wolfSSL_EVP_aes_128_gcm());
 }
 
-static uint64_t crypto_wolfssl_get_aead_max_encryption(WOLFSSL *ssl) {
-  const WOLFSSL_EVP_CIPHER *aead = wolfSSL_quic_get_aead(ssl);
-
+static uint64_t
+crypto_get_aead_max_encryption(const WOLFSSL_EVP_CIPHER *aead) {
   if (wolfSSL_quic_aead_is_gcm(aead)) {
     return NGTCP2_CRYPTO_MAX_ENCRYPTION_AES_GCM;
   }
@@ -88,9 +87,8 @@ static uint64_t crypto_wolfssl_get_aead_max_encryption(WOLFSSL *ssl) {
   return 0;
 }
 
-static uint64_t crypto_wolfssl_get_aead_max_decryption_failure(WOLFSSL *ssl) {
-  const WOLFSSL_EVP_CIPHER *aead = wolfSSL_quic_get_aead(ssl);
-
+static uint64_t
+crypto_get_aead_max_decryption_failure(const WOLFSSL_EVP_CIPHER *aead) {
   if (wolfSSL_quic_aead_is_gcm(aead)) {
     return NGTCP2_CRYPTO_MAX_DECRYPTION_FAILURE_AES_GCM;
   }
@@ -106,13 +104,55 @@ static uint64_t crypto_wolfssl_get_aead_max_decryption_failure(WOLFSSL *ssl) {
 ngtcp2_crypto_ctx *ngtcp2_crypto_ctx_tls(ngtcp2_crypto_ctx *ctx,
                                          void *tls_native_handle) {
   WOLFSSL *ssl = tls_native_handle;
+  const WOLFSSL_EVP_CIPHER *aead = wolfSSL_quic_get_aead(ssl);
 
-  ngtcp2_crypto_aead_init(&ctx->aead, (void *)wolfSSL_quic_get_aead(ssl));
+  ngtcp2_crypto_aead_init(&ctx->aead, (void *)aead);
   ctx->md.native_handle = (void *)wolfSSL_quic_get_md(ssl);
   ctx->hp.native_handle = (void *)wolfSSL_quic_get_hp(ssl);
-  ctx->max_encryption = crypto_wolfssl_get_aead_max_encryption(ssl);
-  ctx->max_decryption_failure =
-      crypto_wolfssl_get_aead_max_decryption_failure(ssl);
+  ctx->max_encryption = crypto_get_aead_max_encryption(aead);
+  ctx->max_decryption_failure = crypto_get_aead_max_decryption_failure(aead);
+  return ctx;
+}
+
+ngtcp2_crypto_ctx *ngtcp2_crypto_ctx_cipher_suite(ngtcp2_crypto_ctx *ctx,
+                                                  uint16_t cipher_suite) {
+  const WOLFSSL_EVP_CIPHER *aead, *hp;
+  const WOLFSSL_EVP_MD *md;
+
+  switch (cipher_suite) {
+  case NGTCP2_CRYPTO_TLS_AES_128_GCM_SHA256:
+    aead = wolfSSL_EVP_aes_128_gcm();
+    md = wolfSSL_EVP_sha256();
+    hp = wolfSSL_EVP_aes_128_ctr();
+    break;
+  case NGTCP2_CRYPTO_TLS_AES_256_GCM_SHA384:
+    aead = wolfSSL_EVP_aes_256_gcm();
+    md = wolfSSL_EVP_sha384();
+    hp = wolfSSL_EVP_aes_256_ctr();
+    break;
+#if defined(HAVE_CHACHA) && defined(HAVE_POLY1305)
+  case NGTCP2_CRYPTO_TLS_CHACHA20_POLY1305_SHA256:
+    aead = wolfSSL_EVP_chacha20_poly1305();
+    md = wolfSSL_EVP_sha256();
+    hp = wolfSSL_EVP_chacha20();
+    break;
+#endif /* HAVE_CHACHA && HAVE_POLY1305 */
+#ifdef HAVE_AESCCM
+  case NGTCP2_CRYPTO_TLS_AES_128_CCM_SHA256:
+    aead = wolfSSL_EVP_aes_128_ccm();
+    md = wolfSSL_EVP_sha256();
+    hp = wolfSSL_EVP_aes_128_ctr();
+    break;
+#endif /* HAVE_AESCCM */
+  default:
+    return NULL;
+  }
+
+  ngtcp2_crypto_aead_init(&ctx->aead, (void *)aead);
+  ctx->md.native_handle = (void *)md;
+  ctx->hp.native_handle = (void *)hp;
+  ctx->max_encryption = crypto_get_aead_max_encryption(aead);
+  ctx->max_decryption_failure = crypto_get_aead_max_decryption_failure(aead);
   return ctx;
 }
 
@@ -179,6 +219,28 @@ int ngtcp2_crypto_aead_ctx_decrypt_init(ngtcp2_crypto_aead_ctx *aead_ctx,
   return 0;
 }
 
+int ngtcp2_crypto_aead_ctx_encrypt_reinit(ngtcp2_crypto_aead_ctx *aead_ctx,
+                                          const ngtcp2_crypto_aead *aead,
+                                          const uint8_t *key,
+                                          size_t noncelen) {
+  /* wolfSSL has no documented way to re-key a QUIC cipher context in
+     place.  Create a new one. */
+  ngtcp2_crypto_aead_ctx_free(aead_ctx);
+  aead_ctx->native_handle = NULL;
+
+  return ngtcp2_crypto_aead_ctx_encrypt_init(aead_ctx, aead, key, noncelen);
+}
+
+int ngtcp2_crypto_aead_ctx_decrypt_reinit(ngtcp2_crypto_aead_ctx *aead_ctx,
+                                          const ngtcp2_crypto_aead *aead,
+                                          const uint8_t *key,
+                                          size_t noncelen) {
+  ngtcp2_crypto_aead_ctx_free(aead_ctx);
+  aead_ctx->native_handle = NULL;
+
+  return ngtcp2_crypto_aead_ctx_decrypt_init(aead_ctx, aead, key, noncelen);
+}
+
 void ngtcp2_crypto_aead_ctx_free(ngtcp2_crypto_aead_ctx *aead_ctx) {
   if (aead_ctx->native_handle) {
     wolfSSL_EVP_CIPHER_CTX_free(aead_ctx->native_handle);
@@ -254,6 +316,17 @@ int ngtcp2_crypto_encrypt(uint8_t *dest, const ngtcp2_crypto_aead *aead,
   return 0;
 }
 
+int ngtcp2_crypto_encrypt_vec(uint8_t *dest, const ngtcp2_crypto_aead *aead,
+                              const ngtcp2_crypto_aead_ctx *aead_ctx,
+                              const ngtcp2_vec *plaintext, size_t plaintextcnt,
+                              const uint8_t *nonce, size_t noncelen,
+                              const uint8_t *aad, size_t aadlen) {
+  /* wolfSSL_quic_aead_encrypt only takes contiguous plaintext. */
+  return ngtcp2_crypto_encrypt_vec_gather(dest, aead, aead_ctx, plaintext,
+                                          plaintextcnt, nonce, noncelen, aad,
+                                          aadlen);
+}
+
 int ngtcp2_crypto_decrypt(uint8_t *dest, const ngtcp2_crypto_aead *aead,
                           const ngtcp2_crypto_aead_ctx *aead_ctx,
                           const uint8_t *ciphertext, size_t ciphertextlen,
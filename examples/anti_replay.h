@@ -0,0 +1,198 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef ANTI_REPLAY_H
+#define ANTI_REPLAY_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+
+#include <ngtcp2/ngtcp2.h>
+
+// AntiReplay is a lock-free filter which detects a replayed 0-RTT
+// ClientHello.  It is shared by all workers through TLSServerContext,
+// so that a replay is caught whichever worker receives it.  The TLS
+// stacks already reject the tickets whose age is outside of their
+// tolerance window (10 seconds by default), so the filter only has to
+// remember the ClientHellos seen during the last 2 windows.
+//
+// Each window has its own blocked Bloom filter: all bits of a key are
+// in a single 64 bit word, so that a key is tested and set with one
+// atomic fetch_or, and 2 workers racing on the same key cannot both
+// accept it.  A false positive only makes the server reject early
+// data, and the client falls back to 1-RTT.
+class AntiReplay {
+public:
+  // NGEN is the number of filters.  The filters of the current and
+  // the previous window are consulted, and the filter of the next
+  // window is cleared in advance, so that no insertion races with the
+  // clearing.
+  static constexpr size_t NGEN = 3;
+  // NHASH is the number of bits set per key.
+  static constexpr size_t NHASH = 4;
+
+  static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+  // |nwords| is the number of 64 bit words per filter.  It must be a
+  // power of 2.  |window| is the duration of a window.
+  explicit AntiReplay(size_t nwords = 1 << 16,
+                      ngtcp2_duration window = 10 * NGTCP2_SECONDS)
+      : words_(std::make_unique<std::atomic<uint64_t>[]>(NGEN * nwords)),
+        nwords_(nwords),
+        window_(window),
+        epoch_(0),
+        seed_(std::random_device{}()) {
+    assert((nwords & (nwords - 1)) == 0);
+    seed_ = (seed_ << 32) ^ std::random_device{}();
+  }
+
+  AntiReplay(const AntiReplay &) = delete;
+  AntiReplay &operator=(const AntiReplay &) = delete;
+
+  // check_and_insert returns true if |data| of length |datalen| has
+  // probably been seen in the current or the previous window.
+  // Otherwise, it records |data| and returns false.  |now| is a
+  // monotonic timestamp.
+  bool check_and_insert(const uint8_t *data, size_t datalen,
+                        ngtcp2_tstamp now) {
+    auto epoch = advance(now / window_);
+    auto h = hash(data, datalen);
+    auto idx = static_cast<size_t>(h) & (nwords_ - 1);
+    uint64_t mask = 0;
+
+    h >>= 32;
+
+    for (size_t i = 0; i < NHASH; ++i) {
+      mask |= 1ull << (h & 63);
+      h >>= 6;
+    }
+
+    auto &prev = word((epoch + NGEN - 1) % NGEN, idx);
+    if ((prev.load(std::memory_order_relaxed) & mask) == mask) {
+      return true;
+    }
+
+    auto &cur = word(epoch % NGEN, idx);
+
+    return (cur.fetch_or(mask, std::memory_order_relaxed) & mask) == mask;
+  }
+
+  // check_and_insert is an overload which uses the steady clock as the
+  // current timestamp.
+  bool check_and_insert(const uint8_t *data, size_t datalen) {
+    auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+                   .count();
+
+    return check_and_insert(data, datalen, static_cast<ngtcp2_tstamp>(now));
+  }
+
+private:
+  std::atomic<uint64_t> &word(size_t gen, size_t idx) {
+    return words_[gen * nwords_ + idx];
+  }
+
+  void clear(size_t gen) {
+    for (size_t i = 0; i < nwords_; ++i) {
+      word(gen, i).store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // advance moves the current window to |epoch| if it is newer, and
+  // returns the current window.
+  uint64_t advance(uint64_t epoch) {
+    auto cur = epoch_.load(std::memory_order_acquire);
+
+    for (;;) {
+      if (epoch <= cur) {
+        return cur;
+      }
+
+      if (epoch_.compare_exchange_weak(cur, epoch,
+                                       std::memory_order_acq_rel)) {
+        break;
+      }
+    }
+
+    if (epoch - cur == 1) {
+      clear((epoch + 1) % NGEN);
+    } else {
+      // The server was idle for more than a window.  All filters are
+      // stale.  A key inserted by another worker while the current
+      // filter is cleared may be forgotten, but this only happens on
+      // the first ClientHello after the idle period.
+      for (size_t i = 0; i < NGEN; ++i) {
+        clear(i);
+      }
+    }
+
+    return epoch;
+  }
+
+  // hash is a seeded 64 bit hash of |data|.  The seed keeps a client
+  // from choosing keys which collide in the filter.
+  uint64_t hash(const uint8_t *data, size_t datalen) const {
+    auto h = seed_ ^ (datalen * 0x9e3779b97f4a7c15ull);
+
+    for (; datalen >= 8; data += 8, datalen -= 8) {
+      uint64_t v;
+      memcpy(&v, data, 8);
+      h = mix(h ^ v);
+    }
+
+    if (datalen) {
+      uint64_t v = 0;
+      memcpy(&v, data, datalen);
+      h = mix(h ^ v);
+    }
+
+    return mix(h);
+  }
+
+  // mix is the finalizer of splitmix64.
+  static uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+  }
+
+  std::unique_ptr<std::atomic<uint64_t>[]> words_;
+  size_t nwords_;
+  ngtcp2_duration window_;
+  // epoch_ is the index of the current window.
+  std::atomic<uint64_t> epoch_;
+  uint64_t seed_;
+};
+
+#endif // ANTI_REPLAY_H
@@ -0,0 +1,88 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "anti_replay_test.h"
+
+#include <array>
+
+#include <CUnit/CUnit.h>
+
+#include "anti_replay.h"
+
+namespace ngtcp2 {
+
+void test_anti_replay_check_and_insert() {
+  AntiReplay ar;
+  std::array<uint8_t, 32> a{}, b{};
+
+  a.fill(0x11);
+  b.fill(0x22);
+
+  CU_ASSERT(!ar.check_and_insert(a.data(), a.size(), 0));
+  CU_ASSERT(ar.check_and_insert(a.data(), a.size(), 0));
+  CU_ASSERT(!ar.check_and_insert(b.data(), b.size(), 0));
+  CU_ASSERT(ar.check_and_insert(b.data(), b.size(), 1));
+
+  // The length is part of the key.
+  CU_ASSERT(!ar.check_and_insert(a.data(), a.size() - 1, 0));
+
+  // A sparse filter rarely yields a false positive.
+  size_t nfp = 0;
+
+  for (uint32_t i = 0; i < 1000; ++i) {
+    std::array<uint8_t, 32> k{};
+
+    memcpy(k.data(), &i, sizeof(i));
+
+    nfp += ar.check_and_insert(k.data(), k.size(), 0);
+  }
+
+  CU_ASSERT(nfp < 10);
+}
+
+void test_anti_replay_window() {
+  constexpr ngtcp2_duration window = 10 * NGTCP2_SECONDS;
+  AntiReplay ar(1 << 10, window);
+  std::array<uint8_t, 32> a{};
+
+  a.fill(0x33);
+
+  CU_ASSERT(!ar.check_and_insert(a.data(), a.size(), 0));
+
+  // The previous window is still consulted.
+  CU_ASSERT(ar.check_and_insert(a.data(), a.size(), window));
+  CU_ASSERT(ar.check_and_insert(a.data(), a.size(), 2 * window - 1));
+
+  // A timestamp in an older window is treated as the current one.
+  CU_ASSERT(ar.check_and_insert(a.data(), a.size(), 0));
+
+  // The key is forgotten after 2 windows.
+  CU_ASSERT(!ar.check_and_insert(a.data(), a.size(), 3 * window));
+  CU_ASSERT(ar.check_and_insert(a.data(), a.size(), 3 * window));
+
+  // After an idle period, all filters are cleared.
+  CU_ASSERT(!ar.check_and_insert(a.data(), a.size(), 10 * window));
+}
+
+} // namespace ngtcp2
@@ -0,0 +1,259 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef CID_MAP_H
+#define CID_MAP_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <cassert>
+#include <cstring>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <ngtcp2/ngtcp2.h>
+
+// CIDMap is an open addressing hash table which maps Connection ID to
+// T.  Keys are stored by value in ngtcp2_cid, so lookup does not
+// allocate.  Collisions are resolved by linear probing, and erase
+// shifts the following entries backward instead of leaving
+// tombstones.  The table doubles its capacity when it becomes half
+// full.  The hash function is seeded randomly so that peers cannot
+// choose colliding Connection IDs.
+template <typename T> class CIDMap {
+public:
+  using value_type = std::pair<ngtcp2_cid, T>;
+
+  // iterator visits occupied slots.  It is invalidated by emplace and
+  // erase.
+  class iterator {
+  public:
+    iterator(std::vector<value_type> *slots, size_t idx)
+        : slots_(slots), idx_(idx) {
+      skip();
+    }
+
+    value_type &operator*() const { return (*slots_)[idx_]; }
+    value_type *operator->() const { return &(*slots_)[idx_]; }
+
+    iterator &operator++() {
+      ++idx_;
+      skip();
+      return *this;
+    }
+
+    bool operator==(const iterator &other) const { return idx_ == other.idx_; }
+    bool operator!=(const iterator &other) const { return idx_ != other.idx_; }
+
+  private:
+    void skip() {
+      for (; idx_ < slots_->size() && (*slots_)[idx_].first.datalen == 0;
+           ++idx_)
+        ;
+    }
+
+    std::vector<value_type> *slots_;
+    size_t idx_;
+  };
+
+  // |capacity| is rounded up to the power of 2.
+  explicit CIDMap(size_t capacity = 1024)
+      : seed_(std::random_device{}() |
+              static_cast<uint64_t>(std::random_device{}()) << 32),
+        size_(0) {
+    size_t n = 16;
+    for (; n < capacity; n *= 2)
+      ;
+    slots_.resize(n);
+    mask_ = n - 1;
+  }
+
+  iterator begin() { return iterator(&slots_, 0); }
+  iterator end() { return iterator(&slots_, slots_.size()); }
+
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+
+  // find returns the pointer to the value associated to |cid| of
+  // length |cidlen|, or nullptr if there is no such entry.
+  T *find(const uint8_t *cid, size_t cidlen) {
+    if (cidlen == 0 || cidlen > NGTCP2_MAX_CIDLEN) {
+      return nullptr;
+    }
+
+    for (auto i = hash(cid, cidlen) & mask_;; i = (i + 1) & mask_) {
+      auto &slot = slots_[i];
+      if (slot.first.datalen == 0) {
+        return nullptr;
+      }
+      if (slot.first.datalen == cidlen &&
+          memcmp(slot.first.data, cid, cidlen) == 0) {
+        return &slot.second;
+      }
+    }
+  }
+
+  T *find(const ngtcp2_cid *cid) { return find(cid->data, cid->datalen); }
+
+  // emplace associates |value| to |cid| of length |cidlen|.  It
+  // returns false and leaves the existing value intact if |cid| is
+  // already in the table.
+  bool emplace(const uint8_t *cid, size_t cidlen, T value) {
+    assert(cidlen);
+    assert(cidlen <= NGTCP2_MAX_CIDLEN);
+
+    if ((size_ + 1) * 2 > slots_.size()) {
+      grow();
+    }
+
+    for (auto i = hash(cid, cidlen) & mask_;; i = (i + 1) & mask_) {
+      auto &slot = slots_[i];
+      if (slot.first.datalen == 0) {
+        ngtcp2_cid_init(&slot.first, cid, cidlen);
+        slot.second = std::move(value);
+        ++size_;
+        return true;
+      }
+      if (slot.first.datalen == cidlen &&
+          memcmp(slot.first.data, cid, cidlen) == 0) {
+        return false;
+      }
+    }
+  }
+
+  bool emplace(const ngtcp2_cid *cid, T value) {
+    return emplace(cid->data, cid->datalen, std::move(value));
+  }
+
+  // erase removes |cid| of length |cidlen| from the table if it
+  // exists.
+  void erase(const uint8_t *cid, size_t cidlen) {
+    if (cidlen == 0 || cidlen > NGTCP2_MAX_CIDLEN) {
+      return;
+    }
+
+    auto i = hash(cid, cidlen) & mask_;
+    for (;; i = (i + 1) & mask_) {
+      auto &slot = slots_[i];
+      if (slot.first.datalen == 0) {
+        return;
+      }
+      if (slot.first.datalen == cidlen &&
+          memcmp(slot.first.data, cid, cidlen) == 0) {
+        break;
+      }
+    }
+
+    // Move back the entries which would become unreachable from
+    // their home slot after slot i is emptied.
+    for (auto j = (i + 1) & mask_;; j = (j + 1) & mask_) {
+      auto &slot = slots_[j];
+      if (slot.first.datalen == 0) {
+        break;
+      }
+
+      auto home = hash(slot.first.data, slot.first.datalen) & mask_;
+      // Keep slot j if its home lies cyclically in (i, j].
+      if (((j - home) & mask_) < ((j - i) & mask_)) {
+        continue;
+      }
+
+      slots_[i] = std::move(slot);
+      i = j;
+    }
+
+    slots_[i].first.datalen = 0;
+    slots_[i].second = T{};
+    --size_;
+  }
+
+  void erase(const ngtcp2_cid *cid) { erase(cid->data, cid->datalen); }
+
+  // prefetch hints CPU to load the home slot of |cid| of length
+  // |cidlen|.  It is intended to be called for every packet in a
+  // receive batch before the packets are processed.
+  void prefetch(const uint8_t *cid, size_t cidlen) const {
+#if defined(__GNUC__) || defined(__clang__)
+    if (cidlen == 0 || cidlen > NGTCP2_MAX_CIDLEN) {
+      return;
+    }
+
+    __builtin_prefetch(&slots_[hash(cid, cidlen) & mask_]);
+#endif // defined(__GNUC__) || defined(__clang__)
+  }
+
+private:
+  uint64_t hash(const uint8_t *cid, size_t cidlen) const {
+    auto h = seed_ ^ (cidlen * 0x9e3779b97f4a7c15llu);
+
+    for (; cidlen >= sizeof(uint64_t);
+         cid += sizeof(uint64_t), cidlen -= sizeof(uint64_t)) {
+      uint64_t w;
+      memcpy(&w, cid, sizeof(w));
+      h = mix(h ^ w);
+    }
+
+    if (cidlen) {
+      uint64_t w = 0;
+      memcpy(&w, cid, cidlen);
+      h = mix(h ^ w);
+    }
+
+    return h;
+  }
+
+  static uint64_t mix(uint64_t h) {
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9llu;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebllu;
+    h ^= h >> 31;
+    return h;
+  }
+
+  void grow() {
+    std::vector<value_type> slots(slots_.size() * 2);
+    std::swap(slots, slots_);
+    mask_ = slots_.size() - 1;
+    size_ = 0;
+
+    for (auto &slot : slots) {
+      if (slot.first.datalen == 0) {
+        continue;
+      }
+
+      emplace(slot.first.data, slot.first.datalen, std::move(slot.second));
+    }
+  }
+
+  std::vector<value_type> slots_;
+  uint64_t seed_;
+  size_t mask_;
+  size_t size_;
+};
+
+#endif // CID_MAP_H
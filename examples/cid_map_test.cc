@@ -0,0 +1,131 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "cid_map_test.h"
+
+#include <array>
+
+#include <CUnit/CUnit.h>
+
+#include "cid_map.h"
+
+namespace ngtcp2 {
+
+namespace {
+ngtcp2_cid make_cid(uint32_t n, size_t cidlen) {
+  ngtcp2_cid cid{};
+
+  cid.datalen = cidlen;
+  memcpy(cid.data, &n, sizeof(n));
+
+  return cid;
+}
+} // namespace
+
+void test_cid_map_find() {
+  CIDMap<int> m;
+  std::array<uint8_t, 18> d{};
+
+  CU_ASSERT(m.empty());
+  CU_ASSERT(nullptr == m.find(d.data(), d.size()));
+  CU_ASSERT(nullptr == m.find(d.data(), 0));
+
+  CU_ASSERT(m.emplace(d.data(), d.size(), 1));
+  CU_ASSERT(!m.emplace(d.data(), d.size(), 2));
+  CU_ASSERT(1 == m.size());
+  CU_ASSERT(1 == *m.find(d.data(), d.size()));
+
+  // Same prefix, but different length.
+  CU_ASSERT(nullptr == m.find(d.data(), d.size() - 1));
+  CU_ASSERT(m.emplace(d.data(), d.size() - 1, 3));
+  CU_ASSERT(3 == *m.find(d.data(), d.size() - 1));
+  CU_ASSERT(1 == *m.find(d.data(), d.size()));
+
+  size_t n = 0;
+  for (auto &p : m) {
+    CU_ASSERT(p.second == 1 || p.second == 3);
+    ++n;
+  }
+
+  CU_ASSERT(2 == n);
+}
+
+void test_cid_map_erase() {
+  CIDMap<int> m(16);
+  std::vector<ngtcp2_cid> cids;
+
+  for (uint32_t i = 0; i < 7; ++i) {
+    cids.push_back(make_cid(i, 8));
+    CU_ASSERT(m.emplace(&cids.back(), static_cast<int>(i)));
+  }
+
+  for (size_t i = 0; i < cids.size(); i += 2) {
+    m.erase(&cids[i]);
+  }
+
+  CU_ASSERT(3 == m.size());
+
+  for (size_t i = 0; i < cids.size(); ++i) {
+    auto p = m.find(&cids[i]);
+    if (i % 2 == 0) {
+      CU_ASSERT(nullptr == p);
+    } else {
+      CU_ASSERT(nullptr != p);
+      CU_ASSERT(static_cast<int>(i) == *p);
+    }
+  }
+
+  // Erasing the absent key is no-op.
+  m.erase(&cids[0]);
+
+  CU_ASSERT(3 == m.size());
+}
+
+void test_cid_map_grow() {
+  CIDMap<int> m(16);
+
+  for (uint32_t i = 0; i < 1000; ++i) {
+    auto cid = make_cid(i, 18);
+    CU_ASSERT(m.emplace(&cid, static_cast<int>(i)));
+  }
+
+  CU_ASSERT(1000 == m.size());
+
+  for (uint32_t i = 0; i < 1000; ++i) {
+    auto cid = make_cid(i, 18);
+    auto p = m.find(&cid);
+    CU_ASSERT(nullptr != p);
+    CU_ASSERT(p && static_cast<int>(i) == *p);
+  }
+
+  for (uint32_t i = 0; i < 1000; ++i) {
+    auto cid = make_cid(i, 18);
+    m.erase(&cid);
+  }
+
+  CU_ASSERT(m.empty());
+  CU_ASSERT(m.begin() == m.end());
+}
+
+} // namespace ngtcp2
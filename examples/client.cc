@@ -27,9 +27,14 @@
 #include <cerrno>
 #include <iostream>
 #include <algorithm>
+#include <limits>
 #include <memory>
 #include <fstream>
 #include <iomanip>
+#include <sstream>
+#include <list>
+#include <thread>
+#include <atomic>
 
 #include <unistd.h>
 #include <getopt.h>
@@ -39,6 +44,7 @@
 #include <sys/socket.h>
 #include <netdb.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 
 #include <http-parser/http_parser.h>
 
@@ -47,22 +53,108 @@
 #include "debug.h"
 #include "util.h"
 #include "shared.h"
+#include "path_cache.h"
+#include "resumption_cache.h"
+#include "file_writer.h"
+#include "http.h"
 
 using namespace ngtcp2;
 using namespace std::literals;
 
 namespace {
-auto randgen = util::make_mt19937();
+thread_local auto randgen = util::make_mt19937();
 } // namespace
 
 namespace {
 constexpr size_t max_preferred_versionslen = 4;
 } // namespace
 
+namespace {
+// rx_msg_ctrllen is the size of ancillary data buffer for an incoming
+// datagram.  It has room for ECN and UDP_GRO segment size.
+constexpr size_t rx_msg_ctrllen =
+    CMSG_SPACE(sizeof(uint8_t)) + CMSG_SPACE(sizeof(int));
+} // namespace
+
+namespace {
+// rx_bufsize is the size of buffer to receive a single UDP datagram.
+// UDP_GRO coalesces datagrams up to this size.
+constexpr size_t rx_bufsize = 64_k;
+} // namespace
+
+namespace {
+// uni_churn_data is the data that each stream of --uni-churn carries.
+// It starts with the reserved stream type 0x21, so that HTTP/3 server
+// discards the stream.
+constexpr std::array<uint8_t, 32> uni_churn_data{0x21};
+} // namespace
+
+namespace {
+// uvarintlen returns the number of bytes required to encode |n| in
+// QUIC variable-length integer encoding.
+size_t uvarintlen(uint64_t n) {
+  if (n < 64) {
+    return 1;
+  }
+  if (n < 16384) {
+    return 2;
+  }
+  if (n < 1073741824) {
+    return 4;
+  }
+  return 8;
+}
+} // namespace
+
 Config config{};
 
+namespace {
+// qlog_sink writes qlog in the background if --qlog-file or
+// --qlog-dir is given.
+QlogSink *qlog_sink;
+} // namespace
+
+namespace {
+// path_cache remembers the congestion control state of the paths if
+// --path-cache-file is given.
+PathCache *path_cache;
+} // namespace
+
+namespace {
+// resumption_cache remembers the resumption state of the servers if
+// --resumption-cache-file is given.
+ResumptionCache *resumption_cache;
+} // namespace
+
+namespace {
+// file_writer writes the segments to the files in the background if
+// --segment-size and --download are given.
+FileWriter *file_writer;
+} // namespace
+
+namespace {
+// wallclock_now returns the current wall-clock time in nanoseconds,
+// which PathCache uses so that its file ages across runs.
+ngtcp2_tstamp wallclock_now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+} // namespace
+
 Stream::Stream(const Request &req, int64_t stream_id)
-    : req(req), stream_id(stream_id), fd(-1) {}
+    : req(req),
+      stream_id(stream_id),
+      fd(-1),
+      checksum{},
+      request_ts(0),
+      response_started(false),
+      download(nullptr),
+      offset(0),
+      seglen(0),
+      nbytes(0),
+      status_code(0),
+      segment_ok(false) {}
 
 Stream::~Stream() {
   if (fd != -1) {
@@ -70,9 +162,11 @@ Stream::~Stream() {
   }
 }
 
-int Stream::open_file(const std::string_view &path) {
-  assert(fd == -1);
-
+namespace {
+// open_download_file opens the file in config.download which the
+// response to |path| is saved to.  It returns the file descriptor, or
+// -1.
+int open_download_file(const std::string_view &path) {
   std::string_view filename;
 
   auto it = std::find(std::rbegin(path), std::rend(path), '/').base();
@@ -90,14 +184,26 @@ int Stream::open_file(const std::string_view &path) {
   fname += '/';
   fname += filename;
 
-  fd = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
-            S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  auto fd = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                 S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
   if (fd == -1) {
     std::cerr << "open: Could not open file " << fname << ": "
               << strerror(errno) << std::endl;
     return -1;
   }
 
+  return fd;
+}
+} // namespace
+
+int Stream::open_file(const std::string_view &path) {
+  assert(fd == -1);
+
+  fd = open_download_file(path);
+  if (fd == -1) {
+    return -1;
+  }
+
   return 0;
 }
 
@@ -164,6 +270,23 @@ void delay_streamcb(struct ev_loop *loop, ev_timer *w, int revents) {
 }
 } // namespace
 
+namespace {
+void uni_churncb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto c = static_cast<Client *>(w->data);
+
+  c->on_uni_churn();
+  c->on_write();
+}
+} // namespace
+
+namespace {
+void netemcb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto c = static_cast<Client *>(w->data);
+
+  c->on_netem();
+}
+} // namespace
+
 namespace {
 void siginthandler(struct ev_loop *loop, ev_signal *w, int revents) {
   ev_break(loop, EVBREAK_ALL);
@@ -179,13 +302,22 @@ Client::Client(struct ev_loop *loop, uint32_t client_chosen_version,
       port_(nullptr),
       nstreams_done_(0),
       nstreams_closed_(0),
+      next_download_(0),
+      submit_segments_(false),
       nkey_update_(0),
       client_chosen_version_(client_chosen_version),
       original_version_(original_version),
       early_data_(false),
       should_exit_(false),
       handshake_confirmed_(false),
-      tx_{} {
+      start_ts_(0),
+      load_stats_(nullptr),
+      rx_stats_{},
+      dl_stats_{},
+      churn_stats_{},
+      churn_{},
+      tx_{},
+      netem_{} {
   ev_io_init(&wev_, writecb, 0, EV_WRITE);
   wev_.data = this;
   ev_timer_init(&timer_, timeoutcb, 0., 0.);
@@ -200,26 +332,67 @@ Client::Client(struct ev_loop *loop, uint32_t client_chosen_version,
   ev_timer_init(&delay_stream_timer_, delay_streamcb,
                 static_cast<double>(config.delay_stream) / NGTCP2_SECONDS, 0.);
   delay_stream_timer_.data = this;
+  // The streams of --uni-churn are scheduled every 10ms.
+  ev_timer_init(&churn_.timer, uni_churncb, 0., 0.01);
+  churn_.timer.data = this;
+  if (config.netem) {
+    netem_.link = std::make_unique<NetEm>(*config.netem);
+  }
+  ev_timer_init(&netem_.timer, netemcb, 0., 0.);
+  netem_.timer.data = this;
   ev_signal_init(&sigintev_, siginthandler, SIGINT);
+  ngtcp2_crypto_aead_ctx_pool_init(&aead_ctx_pool_);
 }
 
 Client::~Client() {
   disconnect();
 
+  for (auto &d : downloads_) {
+    if (d.fd != -1) {
+      file_writer->close(d.fd);
+    }
+  }
+
   if (httpconn_) {
     nghttp3_conn_del(httpconn_);
     httpconn_ = nullptr;
   }
+
+  // Delete conn_ here rather than in ~ClientBase, so that
+  // delete_crypto_aead_ctx can still return the contexts to
+  // aead_ctx_pool_.
+  if (conn_) {
+    ngtcp2_conn_del(conn_);
+    conn_ = nullptr;
+  }
+
+  ngtcp2_crypto_aead_ctx_pool_free(&aead_ctx_pool_);
 }
 
 void Client::disconnect() {
   tx_.send_blocked = false;
 
+  if (path_cache && conn_) {
+    ngtcp2_cc_resume_params params;
+
+    ngtcp2_conn_get_cc_resume_params(conn_, &params);
+    path_cache->put(ngtcp2_conn_get_path(conn_)->remote.addr, params,
+                    wallclock_now());
+  }
+
+  // CONNECTION_CLOSE bypasses the emulated link.
+  netem_.link.reset();
+  ev_timer_stop(loop_, &netem_.timer);
+
   handle_error();
 
-  config.tx_loss_prob = 0;
+  // In load generation mode, the other threads read it.
+  if (config.tx_loss_prob != 0) {
+    config.tx_loss_prob = 0;
+  }
 
   ev_timer_stop(loop_, &delay_stream_timer_);
+  ev_timer_stop(loop_, &churn_.timer);
   ev_timer_stop(loop_, &key_update_timer_);
   ev_timer_stop(loop_, &change_local_addr_timer_);
   ev_timer_stop(loop_, &timer_);
@@ -296,6 +469,35 @@ int handshake_completed(ngtcp2_conn *conn, void *user_data) {
 } // namespace
 
 int Client::handshake_completed() {
+  auto handshake_duration = util::timestamp(loop_) - start_ts_;
+
+  ngtcp2_conn_stat cstat;
+  ngtcp2_conn_get_conn_stat(conn_, &cstat);
+
+  // The handshake is counted in round trips of the minimum RTT
+  // observed so far, rounded to the nearest integer.
+  size_t handshake_rtts = 1;
+  if (cstat.min_rtt != UINT64_MAX && cstat.min_rtt) {
+    handshake_rtts = std::max(
+        static_cast<size_t>((handshake_duration + cstat.min_rtt / 2) /
+                            cstat.min_rtt),
+        size_t{1});
+  }
+
+  if (load_stats_) {
+    load_stats_->handshake.record(handshake_duration);
+
+    auto &rtts = load_stats_->handshake_rtts;
+    ++rtts[std::min(handshake_rtts, rtts.size()) - 1];
+
+    if (early_data_) {
+      ++load_stats_->nearly_data;
+      if (tls_session_.get_early_data_accepted()) {
+        ++load_stats_->nearly_data_accepted;
+      }
+    }
+  }
+
   if (early_data_ && !tls_session_.get_early_data_accepted()) {
     if (!config.quiet) {
       std::cerr << "Early data was rejected by server" << std::endl;
@@ -309,19 +511,40 @@ int Client::handshake_completed() {
     nstreams_done_ = 0;
     streams_.clear();
 
+    // No response to the rejected requests has been received.
+    for (auto &d : downloads_) {
+      d.length = std::numeric_limits<uint64_t>::max();
+      d.next_offset = 0;
+      d.ninflight = 0;
+      d.done = false;
+    }
+
     if (setup_httpconn() != 0) {
       return -1;
     }
   }
 
   if (!config.quiet) {
+    std::cerr << "Handshake completed in " << handshake_rtts
+              << " RTT(s) with " << cstat.handshake_datagrams_sent
+              << " datagram(s) sent" << std::endl;
     std::cerr << "Negotiated cipher suite is " << tls_session_.get_cipher_name()
               << std::endl;
     std::cerr << "Negotiated ALPN is " << tls_session_.get_selected_alpn()
               << std::endl;
   }
 
-  if (config.tp_file) {
+  store_transport_params(ngtcp2_conn_get_remote_transport_params(conn_));
+
+  if (config.uni_churn) {
+    churn_.start_ts = util::timestamp(loop_);
+    ev_timer_again(loop_, &churn_.timer);
+  }
+
+  // In load generation mode, many connections read tp_file at the
+  // same time.  It is written by a preceding run without load
+  // generation mode.
+  if (config.tp_file && !config.load_connections) {
     auto params = ngtcp2_conn_get_remote_transport_params(conn_);
 
     if (write_transport_params(config.tp_file, params) != 0) {
@@ -440,6 +663,19 @@ int extend_max_streams_bidi(ngtcp2_conn *conn, uint64_t max_streams,
 }
 } // namespace
 
+namespace {
+int extend_max_streams_uni(ngtcp2_conn *conn, uint64_t max_streams,
+                           void *user_data) {
+  auto c = static_cast<Client *>(user_data);
+
+  if (c->on_extend_max_streams_uni(max_streams) != 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+} // namespace
+
 namespace {
 void rand(uint8_t *dest, size_t destlen, const ngtcp2_rand_ctx *rand_ctx) {
   auto dis = std::uniform_int_distribution<uint8_t>(0, 255);
@@ -506,6 +742,14 @@ int update_key(ngtcp2_conn *conn, uint8_t *rx_secret, uint8_t *tx_secret,
 }
 } // namespace
 
+namespace {
+void delete_crypto_aead_ctx(ngtcp2_conn *conn, ngtcp2_crypto_aead_ctx *aead_ctx,
+                            void *user_data) {
+  auto c = static_cast<Client *>(user_data);
+  c->release_aead_ctx(aead_ctx);
+}
+} // namespace
+
 namespace {
 int path_validation(ngtcp2_conn *conn, uint32_t flags, const ngtcp2_path *path,
                     ngtcp2_path_validation_result res, void *user_data) {
@@ -569,6 +813,10 @@ int extend_max_stream_data(ngtcp2_conn *conn, int64_t stream_id,
 } // namespace
 
 int Client::extend_max_stream_data(int64_t stream_id, uint64_t max_data) {
+  if (churn_.open.contains(stream_id)) {
+    return 0;
+  }
+
   if (auto rv = nghttp3_conn_unblock_stream(httpconn_, stream_id); rv != 0) {
     std::cerr << "nghttp3_conn_unblock_stream: " << nghttp3_strerror(rv)
               << std::endl;
@@ -580,6 +828,10 @@ int Client::extend_max_stream_data(int64_t stream_id, uint64_t max_data) {
 namespace {
 int recv_new_token(ngtcp2_conn *conn, const ngtcp2_vec *token,
                    void *user_data) {
+  auto c = static_cast<Client *>(user_data);
+
+  c->store_token(std::string{token->base, token->base + token->len});
+
   if (config.token_file.empty()) {
     return 0;
   }
@@ -610,6 +862,31 @@ int Client::init(int fd, const Address &local_addr, const Address &remote_addr,
                  TLSClientContext &tls_ctx) {
   endpoints_.reserve(4);
 
+#ifdef HAVE_RECVMMSG
+  if (config.recv_batch > 1) {
+    auto batch = config.recv_batch;
+
+    rx_.data = std::make_unique<uint8_t[]>(batch * rx_bufsize);
+    rx_.msgs.resize(batch);
+    rx_.iovs.resize(batch);
+    rx_.addrs.resize(batch);
+    rx_.ctrl.resize(batch * rx_msg_ctrllen);
+
+    for (size_t i = 0; i < batch; ++i) {
+      auto &iov = rx_.iovs[i];
+      iov.iov_base = rx_.data.get() + i * rx_bufsize;
+      iov.iov_len = rx_bufsize;
+
+      auto &msg = rx_.msgs[i].msg_hdr;
+      msg = msghdr{};
+      msg.msg_name = &rx_.addrs[i];
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = rx_.ctrl.data() + i * rx_msg_ctrllen;
+    }
+  }
+#endif // HAVE_RECVMMSG
+
   endpoints_.emplace_back();
   auto &ep = endpoints_.back();
   ep.addr = local_addr;
@@ -622,6 +899,32 @@ int Client::init(int fd, const Address &local_addr, const Address &remote_addr,
   addr_ = addr;
   port_ = port;
 
+  resumption_cache_ = ::resumption_cache;
+  authority_ = std::string{addr} + ':' + port;
+
+  if (config.segment_size) {
+    for (auto &req : config.requests) {
+      auto fd = -1;
+
+      if (!config.download.empty()) {
+        fd = open_download_file(req.path);
+        if (fd == -1) {
+          return -1;
+        }
+      }
+
+      downloads_.push_back(Download{
+          .req = req,
+          .fd = fd,
+          .length = std::numeric_limits<uint64_t>::max(),
+          .next_offset = 0,
+          .ninflight = 0,
+          .done = false,
+          .failed = false,
+      });
+    }
+  }
+
   auto callbacks = ngtcp2_callbacks{
       ngtcp2_crypto_client_initial_cb,
       nullptr, // recv_client_initial
@@ -638,7 +941,7 @@ int Client::init(int fd, const Address &local_addr, const Address &remote_addr,
       nullptr, // recv_stateless_reset
       ngtcp2_crypto_recv_retry_cb,
       extend_max_streams_bidi,
-      nullptr, // extend_max_streams_uni
+      extend_max_streams_uni,
       rand,
       get_new_connection_id,
       remove_connection_id,
@@ -652,7 +955,7 @@ int Client::init(int fd, const Address &local_addr, const Address &remote_addr,
       nullptr, // dcid_status
       ::handshake_confirmed,
       ::recv_new_token,
-      ngtcp2_crypto_delete_crypto_aead_ctx_cb,
+      ::delete_crypto_aead_ctx,
       ngtcp2_crypto_delete_crypto_cipher_ctx_cb,
       nullptr, // recv_datagram
       nullptr, // ack_datagram
@@ -662,6 +965,12 @@ int Client::init(int fd, const Address &local_addr, const Address &remote_addr,
       ngtcp2_crypto_version_negotiation_cb,
       ::recv_rx_key,
       nullptr, // recv_tx_key
+      nullptr, // encrypt_batch
+      ngtcp2_crypto_hp_mask_batch_cb,
+      nullptr, // release_stream_buf
+      nullptr, // get_new_connection_ids
+      nullptr, // encrypt_hp_mask
+      ngtcp2_crypto_encrypt_vec_cb,
   };
 
   ngtcp2_cid scid, dcid;
@@ -686,7 +995,7 @@ int Client::init(int fd, const Address &local_addr, const Address &remote_addr,
 
   ngtcp2_settings settings;
   ngtcp2_settings_default(&settings);
-  settings.log_printf = config.quiet ? nullptr : debug::log_printf;
+  settings.log_record = config.quiet ? nullptr : debug::log_record;
   if (!config.qlog_file.empty() || !config.qlog_dir.empty()) {
     std::string path;
     if (!config.qlog_file.empty()) {
@@ -697,40 +1006,57 @@ int Client::init(int fd, const Address &local_addr, const Address &remote_addr,
       path += util::format_hex(scid.data, scid.datalen);
       path += ".sqlog";
     }
-    qlog_ = fopen(path.c_str(), "w");
-    if (qlog_ == nullptr) {
-      std::cerr << "Could not open qlog file " << std::quoted(path) << ": "
-                << strerror(errno) << std::endl;
-      return -1;
-    }
+    qlog_sink_ = qlog_sink;
+    qlog_file_ = qlog_sink_->open(std::move(path));
     settings.qlog.write = qlog_write_cb;
   }
 
   settings.cc_algo = config.cc_algo;
+  if (path_cache) {
+    if (auto params = path_cache->get(&remote_addr.su.sa, wallclock_now());
+        params) {
+      settings.cc_resume = *params;
+    }
+  }
   settings.initial_ts = util::timestamp(loop_);
+  start_ts_ = settings.initial_ts;
   settings.initial_rtt = config.initial_rtt;
   settings.max_window = config.max_window;
   settings.max_stream_window = config.max_stream_window;
   if (config.max_udp_payload_size) {
     settings.max_udp_payload_size = config.max_udp_payload_size;
-    settings.no_udp_payload_size_shaping = 1;
+    settings.no_udp_payload_size_shaping = !config.pmtud_search;
   }
   settings.handshake_timeout = config.handshake_timeout;
   settings.no_pmtud = config.no_pmtud;
+  settings.spin_bit = config.spin_bit;
+  settings.pto_probe_policy = config.pto_probe_policy;
+  settings.pmtud_search = config.pmtud_search;
+  if (config.uni_churn) {
+    // Count the memory usage reported by --uni-churn without limiting
+    // it.
+    settings.mem_budget = std::numeric_limits<uint64_t>::max();
+  }
 
   std::string token;
+  auto resumption_state = get_resumption_state();
 
-  if (!config.token_file.empty()) {
+  if (resumption_state && !resumption_state->token.empty()) {
+    token = std::move(resumption_state->token);
+  } else if (!config.token_file.empty()) {
     std::cerr << "Reading token file " << config.token_file << std::endl;
 
     auto t = util::read_token(config.token_file);
     if (t) {
       token = std::move(*t);
-      settings.token.base = reinterpret_cast<uint8_t *>(token.data());
-      settings.token.len = token.size();
     }
   }
 
+  if (!token.empty()) {
+    settings.token.base = reinterpret_cast<uint8_t *>(token.data());
+    settings.token.len = token.size();
+  }
+
   if (!config.other_versions.empty()) {
     settings.other_versions = config.other_versions.data();
     settings.other_versionslen = config.other_versions.size();
@@ -782,7 +1108,21 @@ int Client::init(int fd, const Address &local_addr, const Address &remote_addr,
 
   ngtcp2_conn_set_tls_native_handle(conn_, tls_session_.get_native_handle());
 
-  if (early_data_ && config.tp_file) {
+  if (early_data_ && resumption_state &&
+      !resumption_state->transport_params.empty()) {
+    ngtcp2_transport_params params;
+    std::istringstream f(resumption_state->transport_params);
+
+    if (read_transport_params(f, &params) != 0) {
+      std::cerr << "Could not read cached transport parameters" << std::endl;
+      early_data_ = false;
+    } else {
+      ngtcp2_conn_set_early_remote_transport_params(conn_, &params);
+      if (make_stream_early() != 0) {
+        return -1;
+      }
+    }
+  } else if (early_data_ && config.tp_file) {
     ngtcp2_transport_params params;
     if (read_transport_params(config.tp_file, &params) != 0) {
       std::cerr << "Could not read transport parameters from " << config.tp_file
@@ -798,7 +1138,11 @@ int Client::init(int fd, const Address &local_addr, const Address &remote_addr,
 
   ev_io_start(loop_, &ep.rev);
 
-  ev_signal_start(loop_, &sigintev_);
+  // A signal can be attached to the default loop only.  In load
+  // generation mode, the main thread handles SIGINT.
+  if (ev_is_default_loop(loop_)) {
+    ev_signal_start(loop_, &sigintev_);
+  }
 
   return 0;
 }
@@ -837,10 +1181,37 @@ int Client::feed_data(const Endpoint &ep, const sockaddr *sa, socklen_t salen,
 }
 
 int Client::on_read(const Endpoint &ep) {
-  std::array<uint8_t, 65536> buf;
+  int rv;
+
+#ifdef HAVE_RECVMMSG
+  if (config.recv_batch > 1) {
+    rv = on_read_batch(ep);
+  } else {
+    rv = on_read_single(ep);
+  }
+#else  // !defined(HAVE_RECVMMSG)
+  rv = on_read_single(ep);
+#endif // !defined(HAVE_RECVMMSG)
+
+  if (rv != 0) {
+    return -1;
+  }
+
+  if (should_exit_) {
+    ngtcp2_connection_close_error_set_application_error(
+        &last_error_, nghttp3_err_infer_quic_app_error_code(0), nullptr, 0);
+    disconnect();
+    return -1;
+  }
+
+  update_timer();
+
+  return 0;
+}
+
+int Client::on_read_single(const Endpoint &ep) {
+  std::array<uint8_t, rx_bufsize> buf;
   sockaddr_union su;
-  size_t pktcnt = 0;
-  ngtcp2_pkt_info pi;
 
   iovec msg_iov;
   msg_iov.iov_base = buf.data();
@@ -851,10 +1222,10 @@ int Client::on_read(const Endpoint &ep) {
   msg.msg_iov = &msg_iov;
   msg.msg_iovlen = 1;
 
-  uint8_t msg_ctrl[CMSG_SPACE(sizeof(uint8_t))];
+  uint8_t msg_ctrl[rx_msg_ctrllen];
   msg.msg_control = msg_ctrl;
 
-  for (;;) {
+  for (size_t pktcnt = 0; pktcnt < 10; ++pktcnt) {
     msg.msg_namelen = sizeof(su);
     msg.msg_controllen = sizeof(msg_ctrl);
 
@@ -867,41 +1238,127 @@ int Client::on_read(const Endpoint &ep) {
       break;
     }
 
-    pi.ecn = msghdr_get_ecn(&msg, su.storage.ss_family);
+    ++rx_stats_.ncall;
+    ++rx_stats_.ndgram;
+
+    if (on_read_msg(ep, &msg, buf.data(), nread) != 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+#ifdef HAVE_RECVMMSG
+int Client::on_read_batch(const Endpoint &ep) {
+  auto batch = config.recv_batch;
+
+  for (size_t ncall = 0; ncall < 10; ++ncall) {
+    for (size_t i = 0; i < batch; ++i) {
+      auto &msg = rx_.msgs[i].msg_hdr;
+      msg.msg_namelen = sizeof(rx_.addrs[i]);
+      msg.msg_controllen = rx_msg_ctrllen;
+      rx_.msgs[i].msg_len = 0;
+    }
+
+    int nmsg;
+
+    do {
+      nmsg = recvmmsg(ep.fd, rx_.msgs.data(), batch, 0, nullptr);
+    } while (nmsg == -1 && errno == EINTR);
+
+    if (nmsg == -1) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        std::cerr << "recvmmsg: " << strerror(errno) << std::endl;
+      }
+      return 0;
+    }
+
+    ++rx_stats_.ncall;
+    rx_stats_.ndgram += nmsg;
+    rx_stats_.max_batch =
+        std::max(rx_stats_.max_batch, static_cast<size_t>(nmsg));
+
+    for (size_t i = 0; i < static_cast<size_t>(nmsg); ++i) {
+      auto &mmsg = rx_.msgs[i];
+
+      if (on_read_msg(ep, &mmsg.msg_hdr,
+                      static_cast<uint8_t *>(rx_.iovs[i].iov_base),
+                      mmsg.msg_len) != 0) {
+        return -1;
+      }
+    }
+
+    if (static_cast<size_t>(nmsg) < batch) {
+      return 0;
+    }
+
+    ++rx_stats_.nfull;
+  }
+
+  return 0;
+}
+#endif // HAVE_RECVMMSG
+
+int Client::on_read_msg(const Endpoint &ep, msghdr *msg, uint8_t *data,
+                        size_t datalen) {
+  auto sa = static_cast<const sockaddr *>(msg->msg_name);
+  auto salen = msg->msg_namelen;
+  ngtcp2_pkt_info pi;
+
+  pi.ecn = msghdr_get_ecn(msg, sa->sa_family);
+
+  auto gso_size = msghdr_get_udp_gro(msg);
+  if (gso_size == 0) {
+    gso_size = datalen;
+  }
+
+  if (gso_size < datalen) {
+    // UDP_GRO coalesces the datagrams from the same 4-tuple, which
+    // belong to this connection.
+    std::array<ngtcp2_vec, 64> pktv;
+    size_t pktvcnt = 0;
+
+    for (auto p = data, end = data + datalen;
+         p != end && pktvcnt < pktv.size();) {
+      auto len = std::min(gso_size, static_cast<size_t>(end - p));
+      pktv[pktvcnt++] = {p, len};
+      p += len;
+    }
+
+    if (auto rv = ngtcp2_conn_prepare_rx_hp_masks(conn_, pktv.data(), pktvcnt);
+        rv != 0) {
+      std::cerr << "ngtcp2_conn_prepare_rx_hp_masks: " << ngtcp2_strerror(rv)
+                << std::endl;
+    }
+  }
+
+  // Each segment of UDP_GRO coalesced datagrams is processed as if it
+  // was received separately.
+  for (auto end = data + datalen; data != end;) {
+    auto len = std::min(gso_size, static_cast<size_t>(end - data));
+
+    ++rx_stats_.nseg;
 
     if (!config.quiet) {
       std::cerr << "Received packet: local="
                 << util::straddr(&ep.addr.su.sa, ep.addr.len)
-                << " remote=" << util::straddr(&su.sa, msg.msg_namelen)
-                << " ecn=0x" << std::hex << pi.ecn << std::dec << " " << nread
-                << " bytes" << std::endl;
+                << " remote=" << util::straddr(sa, salen) << " ecn=0x"
+                << std::hex << pi.ecn << std::dec << " " << len << " bytes"
+                << std::endl;
     }
 
     if (debug::packet_lost(config.rx_loss_prob)) {
       if (!config.quiet) {
         std::cerr << "** Simulated incoming packet loss **" << std::endl;
       }
-      break;
-    }
-
-    if (feed_data(ep, &su.sa, msg.msg_namelen, &pi, buf.data(), nread) != 0) {
+    } else if (feed_data(ep, sa, salen, &pi, data, len) != 0) {
       return -1;
     }
 
-    if (++pktcnt >= 10) {
-      break;
-    }
-  }
-
-  if (should_exit_) {
-    ngtcp2_connection_close_error_set_application_error(
-        &last_error_, nghttp3_err_infer_quic_app_error_code(0), nullptr, 0);
-    disconnect();
-    return -1;
+    data += len;
   }
 
-  update_timer();
-
   return 0;
 }
 
@@ -963,8 +1420,17 @@ int Client::write_streams() {
     int64_t stream_id = -1;
     int fin = 0;
     nghttp3_ssize sveccnt = 0;
-
-    if (httpconn_ && ngtcp2_conn_get_max_data_left(conn_)) {
+    // churn is true if stream_id is a stream of --uni-churn.
+    auto churn = false;
+
+    if (!churn_.tx.empty() && ngtcp2_conn_get_max_data_left(conn_)) {
+      churn = true;
+      stream_id = churn_.tx.front();
+      fin = 1;
+      vec[0].base = const_cast<uint8_t *>(uni_churn_data.data()) + churn_.txoff;
+      vec[0].len = uni_churn_data.size() - churn_.txoff;
+      sveccnt = 1;
+    } else if (httpconn_ && ngtcp2_conn_get_max_data_left(conn_)) {
       sveccnt = nghttp3_conn_writev_stream(httpconn_, &stream_id, &fin,
                                            vec.data(), vec.size());
       if (sveccnt < 0) {
@@ -996,14 +1462,32 @@ int Client::write_streams() {
       switch (nwrite) {
       case NGTCP2_ERR_STREAM_DATA_BLOCKED:
         assert(ndatalen == -1);
+        if (churn) {
+          // Peer does not let the stream carry its few bytes.  Give
+          // up the stream rather than waiting for MAX_STREAM_DATA.
+          ngtcp2_conn_shutdown_stream_write(conn_, stream_id,
+                                            NGHTTP3_H3_REQUEST_CANCELLED);
+          churn_.tx.pop_front();
+          churn_.txoff = 0;
+          continue;
+        }
         nghttp3_conn_block_stream(httpconn_, stream_id);
         continue;
       case NGTCP2_ERR_STREAM_SHUT_WR:
         assert(ndatalen == -1);
+        if (churn) {
+          churn_.tx.pop_front();
+          churn_.txoff = 0;
+          continue;
+        }
         nghttp3_conn_shutdown_stream_write(httpconn_, stream_id);
         continue;
       case NGTCP2_ERR_WRITE_MORE:
         assert(ndatalen >= 0);
+        if (churn) {
+          add_churn_write_offset(static_cast<size_t>(ndatalen));
+          continue;
+        }
         if (auto rv =
                 nghttp3_conn_add_write_offset(httpconn_, stream_id, ndatalen);
             rv != 0) {
@@ -1026,6 +1510,8 @@ int Client::write_streams() {
           &last_error_, nwrite, nullptr, 0);
       disconnect();
       return -1;
+    } else if (ndatalen >= 0 && churn) {
+      add_churn_write_offset(static_cast<size_t>(ndatalen));
     } else if (ndatalen >= 0) {
       if (auto rv =
               nghttp3_conn_add_write_offset(httpconn_, stream_id, ndatalen);
@@ -1186,6 +1672,11 @@ int udp_sock(int family) {
   fd_set_ip_mtu_discover(fd, family);
   fd_set_ip_dontfrag(fd, family);
 
+  if (config.gro && fd_set_udp_gro(fd) != 0) {
+    close(fd);
+    return -1;
+  }
+
   return fd;
 }
 } // namespace
@@ -1354,6 +1845,10 @@ int Client::change_local_addr() {
   return 0;
 }
 
+void Client::release_aead_ctx(ngtcp2_crypto_aead_ctx *aead_ctx) {
+  ngtcp2_crypto_aead_ctx_pool_release(&aead_ctx_pool_, aead_ctx);
+}
+
 void Client::start_key_update_timer() {
   ev_timer_start(loop_, &key_update_timer_);
 }
@@ -1376,10 +1871,10 @@ int Client::update_key(uint8_t *rx_secret, uint8_t *tx_secret,
 
   std::array<uint8_t, 64> rx_key, tx_key;
 
-  if (ngtcp2_crypto_update_key(conn_, rx_secret, tx_secret, rx_aead_ctx,
-                               rx_key.data(), rx_iv, tx_aead_ctx, tx_key.data(),
-                               tx_iv, current_rx_secret, current_tx_secret,
-                               secretlen) != 0) {
+  if (ngtcp2_crypto_update_key_pooled(
+          conn_, rx_secret, tx_secret, rx_aead_ctx, rx_key.data(), rx_iv,
+          tx_aead_ctx, tx_key.data(), tx_iv, current_rx_secret,
+          current_tx_secret, secretlen, &aead_ctx_pool_) != 0) {
     return -1;
   }
 
@@ -1416,6 +1911,58 @@ void Client::start_delay_stream_timer() {
 
 int Client::send_packet(const Endpoint &ep, const ngtcp2_addr &remote_addr,
                         unsigned int ecn, const uint8_t *data, size_t datalen) {
+  if (!netem_.link) {
+    return send_packet_now(ep, remote_addr, ecn, data, datalen);
+  }
+
+  ngtcp2_addr local_addr{
+      .addr = const_cast<sockaddr *>(&ep.addr.su.sa),
+      .addrlen = ep.addr.len,
+  };
+
+  netem_.link->send(const_cast<Endpoint *>(&ep), local_addr, remote_addr, ecn,
+                    data, datalen, util::timestamp(loop_));
+
+  update_netem_timer();
+
+  return NETWORK_ERR_OK;
+}
+
+void Client::update_netem_timer() {
+  auto expiry = netem_.link->expiry();
+  if (expiry == UINT64_MAX) {
+    ev_timer_stop(loop_, &netem_.timer);
+    return;
+  }
+
+  auto now = util::timestamp(loop_);
+
+  // ev_timer_again stops the timer if repeat is 0.
+  netem_.timer.repeat =
+      expiry > now ? static_cast<ev_tstamp>(expiry - now) / NGTCP2_SECONDS
+                   : 1e-9;
+  ev_timer_again(loop_, &netem_.timer);
+}
+
+void Client::on_netem() {
+  netem_.link->deliver(util::timestamp(loop_), [this](NetEmPacket &pkt) {
+    ngtcp2_addr remote_addr{
+        .addr = &pkt.remote_addr.su.sa,
+        .addrlen = pkt.remote_addr.len,
+    };
+
+    // The packet which the socket cannot take is dropped as the
+    // router would do.
+    send_packet_now(*static_cast<Endpoint *>(pkt.user_data), remote_addr,
+                    pkt.ecn, pkt.data.data(), pkt.data.size());
+  });
+
+  update_netem_timer();
+}
+
+int Client::send_packet_now(const Endpoint &ep, const ngtcp2_addr &remote_addr,
+                            unsigned int ecn, const uint8_t *data,
+                            size_t datalen) {
   if (debug::packet_lost(config.tx_loss_prob)) {
     if (!config.quiet) {
       std::cerr << "** Simulated outgoing packet loss **" << std::endl;
@@ -1559,8 +2106,19 @@ int Client::handle_error() {
 }
 
 int Client::on_stream_close(int64_t stream_id, uint64_t app_error_code) {
-  if (httpconn_) {
-    if (app_error_code == 0) {
+  if (churn_.open.erase(stream_id)) {
+    ++churn_stats_.nclosed;
+    churn_stats_.last_ts = util::timestamp(loop_);
+
+    if (config.exit_on_all_streams_close && all_streams_closed()) {
+      should_exit_ = true;
+    }
+
+    return 0;
+  }
+
+  if (httpconn_) {
+    if (app_error_code == 0) {
       app_error_code = NGHTTP3_H3_NO_ERROR;
     }
     auto rv = nghttp3_conn_close_stream(httpconn_, stream_id, app_error_code);
@@ -1589,7 +2147,7 @@ int Client::on_stream_close(int64_t stream_id, uint64_t app_error_code) {
 }
 
 int Client::on_stream_reset(int64_t stream_id) {
-  if (httpconn_) {
+  if (httpconn_ && !churn_.open.contains(stream_id)) {
     if (auto rv = nghttp3_conn_shutdown_stream_read(httpconn_, stream_id);
         rv != 0) {
       std::cerr << "nghttp3_conn_shutdown_stream_read: " << nghttp3_strerror(rv)
@@ -1601,7 +2159,7 @@ int Client::on_stream_reset(int64_t stream_id) {
 }
 
 int Client::on_stream_stop_sending(int64_t stream_id) {
-  if (!httpconn_) {
+  if (!httpconn_ || churn_.open.contains(stream_id)) {
     return 0;
   }
 
@@ -1615,6 +2173,90 @@ int Client::on_stream_stop_sending(int64_t stream_id) {
   return 0;
 }
 
+int Client::on_extend_max_streams_uni(uint64_t max_streams) {
+  if (!config.uni_churn) {
+    return 0;
+  }
+
+  // The first call tells the limit in the transport parameters.  The
+  // later ones are caused by MAX_STREAMS frames.
+  if (churn_.max_streams) {
+    ++churn_stats_.nmax_streams;
+    churn_stats_.max_streams_bytes += 1 + uvarintlen(max_streams);
+  }
+
+  churn_.max_streams = max_streams;
+
+  open_churn_streams();
+
+  return 0;
+}
+
+void Client::on_uni_churn() {
+  auto now = util::timestamp(loop_);
+  // The first stream is due as soon as the timer starts.
+  auto n = std::min(config.uni_churn,
+                    static_cast<size_t>((now - churn_.start_ts) *
+                                        config.uni_churn_rate /
+                                        NGTCP2_SECONDS) +
+                        1);
+
+  for (; churn_.nscheduled < n; ++churn_.nscheduled) {
+    churn_.due.push_back(now);
+  }
+
+  if (churn_.nscheduled == config.uni_churn) {
+    ev_timer_stop(loop_, &churn_.timer);
+  }
+
+  open_churn_streams();
+}
+
+void Client::open_churn_streams() {
+  auto now = util::timestamp(loop_);
+
+  for (; !churn_.due.empty(); churn_.due.pop_front()) {
+    int64_t stream_id;
+
+    if (auto rv = ngtcp2_conn_open_uni_stream(conn_, &stream_id, nullptr);
+        rv != 0) {
+      assert(NGTCP2_ERR_STREAM_ID_BLOCKED == rv);
+      return;
+    }
+
+    ngtcp2_mem_stat ms;
+
+    if (churn_stats_.nopened++ == 0) {
+      churn_stats_.first_ts = now;
+
+      ngtcp2_conn_get_mem_stat(conn_, &ms);
+      churn_.mem_base = ms.total;
+    }
+
+    churn_stats_.open_latency.record(now - churn_.due.front());
+
+    churn_.open.insert(stream_id);
+    churn_.tx.push_back(stream_id);
+
+    if (churn_.open.size() > churn_stats_.peak_open) {
+      ngtcp2_conn_get_mem_stat(conn_, &ms);
+
+      churn_stats_.peak_open = churn_.open.size();
+      churn_stats_.peak_mem =
+          ms.total > churn_.mem_base ? ms.total - churn_.mem_base : 0;
+    }
+  }
+}
+
+void Client::add_churn_write_offset(size_t datalen) {
+  churn_.txoff += datalen;
+
+  if (churn_.txoff == uni_churn_data.size()) {
+    churn_.tx.pop_front();
+    churn_.txoff = 0;
+  }
+}
+
 int Client::make_stream_early() {
   if (setup_httpconn() != 0) {
     return -1;
@@ -1631,6 +2273,10 @@ int Client::on_extend_max_streams() {
     return 0;
   }
 
+  if (config.segment_size) {
+    return submit_segments();
+  }
+
   for (; nstreams_done_ < config.nstreams; ++nstreams_done_) {
     if (auto rv = ngtcp2_conn_open_bidi_stream(conn_, &stream_id, nullptr);
         rv != 0) {
@@ -1645,6 +2291,8 @@ int Client::on_extend_max_streams() {
       break;
     }
 
+    stream->request_ts = util::timestamp(loop_);
+
     if (!config.download.empty()) {
       stream->open_file(stream->req.path);
     }
@@ -1653,6 +2301,67 @@ int Client::on_extend_max_streams() {
   return 0;
 }
 
+int Client::submit_segments() {
+  int64_t stream_id;
+
+  for (;;) {
+    Download *d = nullptr;
+
+    for (size_t i = 0; i < downloads_.size(); ++i) {
+      auto &cand = downloads_[(next_download_ + i) % downloads_.size()];
+      if (cand.done) {
+        continue;
+      }
+
+      // The length is unknown until the response to the first segment
+      // arrives.
+      if (cand.length == std::numeric_limits<uint64_t>::max() &&
+          (cand.next_offset || cand.ninflight)) {
+        continue;
+      }
+
+      d = &cand;
+      next_download_ = (next_download_ + i + 1) % downloads_.size();
+
+      break;
+    }
+
+    if (!d) {
+      return 0;
+    }
+
+    if (auto rv = ngtcp2_conn_open_bidi_stream(conn_, &stream_id, nullptr);
+        rv != 0) {
+      assert(NGTCP2_ERR_STREAM_ID_BLOCKED == rv);
+      return 0;
+    }
+
+    auto stream = std::make_unique<Stream>(d->req, stream_id);
+    stream->download = d;
+    stream->offset = d->next_offset;
+    stream->seglen = config.segment_size;
+    if (d->length != std::numeric_limits<uint64_t>::max()) {
+      stream->seglen = std::min(stream->seglen, d->length - stream->offset);
+    }
+
+    if (submit_http_request(stream.get()) != 0) {
+      return -1;
+    }
+
+    stream->request_ts = util::timestamp(loop_);
+
+    d->next_offset += stream->seglen;
+    if (d->next_offset >= d->length) {
+      d->done = true;
+    }
+
+    ++d->ninflight;
+    ++nstreams_done_;
+
+    streams_.emplace(stream_id, std::move(stream));
+  }
+}
+
 namespace {
 nghttp3_ssize read_data(nghttp3_conn *conn, int64_t stream_id, nghttp3_vec *vec,
                         size_t veccnt, uint32_t *pflags, void *user_data,
@@ -1666,11 +2375,11 @@ nghttp3_ssize read_data(nghttp3_conn *conn, int64_t stream_id, nghttp3_vec *vec,
 } // namespace
 
 int Client::submit_http_request(const Stream *stream) {
-  std::string content_length_str;
+  std::string content_length_str, range_str;
 
   const auto &req = stream->req;
 
-  std::array<nghttp3_nv, 6> nva{
+  std::array<nghttp3_nv, 7> nva{
       util::make_nv(":method", config.http_method),
       util::make_nv(":scheme", req.scheme),
       util::make_nv(":authority", req.authority),
@@ -1682,6 +2391,11 @@ int Client::submit_http_request(const Stream *stream) {
     content_length_str = util::format_uint(config.datalen);
     nva[nvlen++] = util::make_nv("content-length", content_length_str);
   }
+  if (stream->download) {
+    range_str = "bytes=" + util::format_uint(stream->offset) + '-' +
+                util::format_uint(stream->offset + stream->seglen - 1);
+    nva[nvlen++] = util::make_nv("range", range_str);
+  }
 
   if (!config.quiet) {
     debug::print_http_request_headers(stream->stream_id, nva.data(), nvlen);
@@ -1704,6 +2418,25 @@ int Client::submit_http_request(const Stream *stream) {
 
 int Client::recv_stream_data(uint32_t flags, int64_t stream_id,
                              const uint8_t *data, size_t datalen) {
+  if (config.bench_download && ngtcp2_is_bidi_stream(stream_id)) {
+    // The response is counted and discarded without being parsed.
+    // HTTP/3 stack still learns the closure of the stream from
+    // on_stream_close.
+    auto now = util::timestamp(loop_);
+
+    if (dl_stats_.nbytes == 0) {
+      dl_stats_.first_ts = now;
+    }
+
+    dl_stats_.nbytes += datalen;
+    dl_stats_.last_ts = now;
+
+    ngtcp2_conn_extend_max_stream_offset(conn_, stream_id, datalen);
+    ngtcp2_conn_extend_max_offset(conn_, datalen);
+
+    return 0;
+  }
+
   auto nconsumed = nghttp3_conn_read_stream(
       httpconn_, stream_id, data, datalen, flags & NGTCP2_STREAM_DATA_FLAG_FIN);
   if (nconsumed < 0) {
@@ -1718,6 +2451,15 @@ int Client::recv_stream_data(uint32_t flags, int64_t stream_id,
   ngtcp2_conn_extend_max_stream_offset(conn_, stream_id, nconsumed);
   ngtcp2_conn_extend_max_offset(conn_, nconsumed);
 
+  // The streams are not opened from the callbacks of HTTP/3 stack.
+  if (submit_segments_) {
+    submit_segments_ = false;
+
+    if (on_extend_max_streams() != 0) {
+      return -1;
+    }
+  }
+
   return 0;
 }
 
@@ -1826,6 +2568,10 @@ void Client::http_consume(int64_t stream_id, size_t nconsumed) {
 
 void Client::http_write_data(int64_t stream_id, const uint8_t *data,
                              size_t datalen) {
+  if (load_stats_) {
+    load_stats_->nbytes += datalen;
+  }
+
   auto it = streams_.find(stream_id);
   if (it == std::end(streams_)) {
     return;
@@ -1833,6 +2579,25 @@ void Client::http_write_data(int64_t stream_id, const uint8_t *data,
 
   auto &stream = (*it).second;
 
+  if (config.verify_checksum) {
+    stream->checksum.update(data, datalen);
+  }
+
+  if (stream->download) {
+    if (!stream->segment_ok) {
+      return;
+    }
+
+    if (stream->download->fd != -1) {
+      file_writer->write(stream->download->fd,
+                         stream->offset + stream->nbytes, data, datalen);
+    }
+
+    stream->nbytes += datalen;
+
+    return;
+  }
+
   if (stream->fd == -1) {
     return;
   }
@@ -1843,16 +2608,87 @@ void Client::http_write_data(int64_t stream_id, const uint8_t *data,
   } while (nwrite == -1 && errno == EINTR);
 }
 
+void Client::http_verify_checksum(int64_t stream_id,
+                                  const std::string_view &value) {
+  auto it = streams_.find(stream_id);
+  if (it == std::end(streams_)) {
+    return;
+  }
+
+  auto &stream = (*it).second;
+  auto checksum = format_dyn_checksum(stream->checksum);
+
+  if (checksum != value) {
+    std::cerr << "stream " << stream_id
+              << ": checksum mismatch: expected=" << value
+              << " actual=" << checksum << std::endl;
+  } else if (!config.quiet) {
+    std::cerr << "stream " << stream_id << ": checksum verified" << std::endl;
+  }
+}
+
+void Client::http_begin_headers(int64_t stream_id) {
+  if (!load_stats_) {
+    return;
+  }
+
+  auto it = streams_.find(stream_id);
+  if (it == std::end(streams_)) {
+    return;
+  }
+
+  auto &stream = (*it).second;
+
+  // Interim responses precede the final response.  Only the first
+  // header block counts.
+  if (stream->response_started) {
+    return;
+  }
+
+  stream->response_started = true;
+
+  load_stats_->ttfb.record(util::timestamp(loop_) - stream->request_ts);
+}
+
 namespace {
 int http_begin_headers(nghttp3_conn *conn, int64_t stream_id, void *user_data,
                        void *stream_user_data) {
   if (!config.quiet) {
     debug::print_http_begin_response_headers(stream_id);
   }
+
+  auto c = static_cast<Client *>(user_data);
+  c->http_begin_headers(stream_id);
+
   return 0;
 }
 } // namespace
 
+void Client::http_recv_header(int64_t stream_id, int32_t token,
+                              const nghttp3_vec &name,
+                              const nghttp3_vec &value) {
+  auto it = streams_.find(stream_id);
+  if (it == std::end(streams_)) {
+    return;
+  }
+
+  auto &stream = (*it).second;
+  auto v = std::string_view{reinterpret_cast<const char *>(value.base),
+                            value.len};
+
+  if (token == NGHTTP3_QPACK_TOKEN__STATUS) {
+    if (auto n = util::parse_uint(v); n) {
+      stream->status_code = static_cast<unsigned int>(*n);
+    }
+
+    return;
+  }
+
+  if (util::streq_l("content-range", name)) {
+    stream->content_range = v;
+  }
+}
+
 namespace {
 int http_recv_header(nghttp3_conn *conn, int64_t stream_id, int32_t token,
                      nghttp3_rcbuf *name, nghttp3_rcbuf *value, uint8_t flags,
@@ -1860,16 +2696,88 @@ int http_recv_header(nghttp3_conn *conn, int64_t stream_id, int32_t token,
   if (!config.quiet) {
     debug::print_http_header(stream_id, name, value, flags);
   }
+
+  if (config.segment_size) {
+    auto c = static_cast<Client *>(user_data);
+    c->http_recv_header(stream_id, token, nghttp3_rcbuf_get_buf(name),
+                        nghttp3_rcbuf_get_buf(value));
+  }
+
   return 0;
 }
 } // namespace
 
+void Client::http_end_headers(int64_t stream_id) {
+  auto it = streams_.find(stream_id);
+  if (it == std::end(streams_)) {
+    return;
+  }
+
+  auto &stream = (*it).second;
+  auto d = stream->download;
+
+  // Interim responses precede the final response.
+  if (!d || stream->status_code / 100 == 1) {
+    return;
+  }
+
+  switch (stream->status_code) {
+  case 206: {
+    auto cr = http::parse_content_range(stream->content_range);
+    if (!cr || cr->range.first != stream->offset ||
+        (d->length != std::numeric_limits<uint64_t>::max() &&
+         cr->length != d->length)) {
+      break;
+    }
+
+    stream->seglen = cr->range.last - cr->range.first + 1;
+    stream->segment_ok = true;
+
+    if (d->length == std::numeric_limits<uint64_t>::max()) {
+      d->length = cr->length;
+      if (d->next_offset >= d->length) {
+        d->done = true;
+      }
+
+      submit_segments_ = true;
+    }
+
+    return;
+  }
+  case 200:
+    // The server ignores the range.  The first segment is the whole
+    // object.
+    if (stream->offset == 0) {
+      stream->seglen = std::numeric_limits<uint64_t>::max();
+      stream->segment_ok = true;
+      d->done = true;
+
+      return;
+    }
+
+    break;
+  }
+
+  std::cerr << "stream " << stream_id << ": could not fetch the segment at "
+            << stream->offset << " of " << d->req.path
+            << ": status=" << stream->status_code << std::endl;
+
+  d->done = true;
+  d->failed = true;
+}
+
 namespace {
 int http_end_headers(nghttp3_conn *conn, int64_t stream_id, int fin,
                      void *user_data, void *stream_user_data) {
   if (!config.quiet) {
     debug::print_http_end_headers(stream_id);
   }
+
+  if (config.segment_size) {
+    auto c = static_cast<Client *>(user_data);
+    c->http_end_headers(stream_id);
+  }
+
   return 0;
 }
 } // namespace
@@ -1891,6 +2799,16 @@ int http_recv_trailer(nghttp3_conn *conn, int64_t stream_id, int32_t token,
   if (!config.quiet) {
     debug::print_http_header(stream_id, name, value, flags);
   }
+
+  if (config.verify_checksum &&
+      util::streq_l("x-ngtcp2-checksum", nghttp3_rcbuf_get_buf(name))) {
+    auto c = static_cast<Client *>(user_data);
+    auto v = nghttp3_rcbuf_get_buf(value);
+
+    c->http_verify_checksum(
+        stream_id, {reinterpret_cast<const char *>(v.base), v.len});
+  }
+
   return 0;
 }
 } // namespace
@@ -1969,10 +2887,13 @@ int Client::http_stream_close(int64_t stream_id, uint64_t app_error_code) {
 
     ++nstreams_closed_;
 
+    if (auto it = streams_.find(stream_id);
+        it != std::end(streams_) && (*it).second->download) {
+      close_segment(*(*it).second, app_error_code);
+    }
+
     if (config.exit_on_first_stream_close ||
-        (config.exit_on_all_streams_close &&
-         config.nstreams == nstreams_done_ &&
-         nstreams_closed_ == nstreams_done_)) {
+        (config.exit_on_all_streams_close && all_streams_closed())) {
       should_exit_ = true;
     }
   } else {
@@ -1985,12 +2906,68 @@ int Client::http_stream_close(int64_t stream_id, uint64_t app_error_code) {
       std::cerr << "HTTP stream " << stream_id << " closed with error code "
                 << app_error_code << std::endl;
     }
+
+    if (load_stats_) {
+      load_stats_->completion.record(util::timestamp(loop_) -
+                                     (*it).second->request_ts);
+    }
+
     streams_.erase(it);
   }
 
   return 0;
 }
 
+void Client::close_segment(const Stream &stream, uint64_t app_error_code) {
+  auto d = stream.download;
+
+  assert(d->ninflight);
+
+  --d->ninflight;
+
+  if (stream.segment_ok && app_error_code == NGHTTP3_H3_NO_ERROR &&
+      stream.seglen == std::numeric_limits<uint64_t>::max()) {
+    // The whole object has been received.
+    d->length = stream.nbytes;
+  } else if (!d->failed &&
+             (!stream.segment_ok || app_error_code != NGHTTP3_H3_NO_ERROR ||
+              stream.nbytes != stream.seglen)) {
+    std::cerr << "stream " << stream.stream_id << ": segment at "
+              << stream.offset << " of " << d->req.path
+              << " is incomplete: received " << stream.nbytes << " bytes"
+              << std::endl;
+
+    d->done = true;
+    d->failed = true;
+  }
+
+  if (!config.quiet) {
+    auto elapsed = util::timestamp(loop_) - stream.request_ts;
+    auto secs = static_cast<double>(elapsed) / NGTCP2_SECONDS;
+    auto mbps = secs > 0 ? static_cast<double>(stream.nbytes) * 8 / secs /
+                               1'000'000
+                         : 0.;
+
+    std::cerr << "stream " << stream.stream_id << ": segment of "
+              << d->req.path << " offset=" << stream.offset
+              << " bytes=" << stream.nbytes
+              << " elapsed=" << util::format_durationf(elapsed)
+              << " throughput=" << mbps << "Mbps" << std::endl;
+  }
+
+  if (d->done && d->ninflight == 0) {
+    if (d->fd != -1) {
+      file_writer->close(d->fd);
+      d->fd = -1;
+    }
+
+    if (!config.quiet && !d->failed) {
+      std::cerr << "Downloaded " << d->req.path << " (" << d->length
+                << " bytes)" << std::endl;
+    }
+  }
+}
+
 int Client::setup_httpconn() {
   if (httpconn_) {
     return 0;
@@ -2033,105 +3010,548 @@ int Client::setup_httpconn() {
     return -1;
   }
 
-  int64_t ctrl_stream_id;
+  int64_t ctrl_stream_id;
+
+  if (auto rv = ngtcp2_conn_open_uni_stream(conn_, &ctrl_stream_id, nullptr);
+      rv != 0) {
+    std::cerr << "ngtcp2_conn_open_uni_stream: " << ngtcp2_strerror(rv)
+              << std::endl;
+    return -1;
+  }
+
+  if (auto rv = nghttp3_conn_bind_control_stream(httpconn_, ctrl_stream_id);
+      rv != 0) {
+    std::cerr << "nghttp3_conn_bind_control_stream: " << nghttp3_strerror(rv)
+              << std::endl;
+    return -1;
+  }
+
+  if (!config.quiet) {
+    fprintf(stderr, "http: control stream=%" PRIx64 "\n", ctrl_stream_id);
+  }
+
+  int64_t qpack_enc_stream_id, qpack_dec_stream_id;
+
+  if (auto rv =
+          ngtcp2_conn_open_uni_stream(conn_, &qpack_enc_stream_id, nullptr);
+      rv != 0) {
+    std::cerr << "ngtcp2_conn_open_uni_stream: " << ngtcp2_strerror(rv)
+              << std::endl;
+    return -1;
+  }
+
+  if (auto rv =
+          ngtcp2_conn_open_uni_stream(conn_, &qpack_dec_stream_id, nullptr);
+      rv != 0) {
+    std::cerr << "ngtcp2_conn_open_uni_stream: " << ngtcp2_strerror(rv)
+              << std::endl;
+    return -1;
+  }
+
+  if (auto rv = nghttp3_conn_bind_qpack_streams(httpconn_, qpack_enc_stream_id,
+                                                qpack_dec_stream_id);
+      rv != 0) {
+    std::cerr << "nghttp3_conn_bind_qpack_streams: " << nghttp3_strerror(rv)
+              << std::endl;
+    return -1;
+  }
+
+  if (!config.quiet) {
+    fprintf(stderr,
+            "http: QPACK streams encoder=%" PRIx64 " decoder=%" PRIx64 "\n",
+            qpack_enc_stream_id, qpack_dec_stream_id);
+  }
+
+  return 0;
+}
+
+const std::vector<uint32_t> &Client::get_offered_versions() const {
+  return offered_versions_;
+}
+
+void Client::set_load_stats(LoadStats *st) { load_stats_ = st; }
+
+bool Client::disconnected() const { return endpoints_.empty(); }
+
+bool Client::all_streams_closed() const {
+  if (churn_stats_.nclosed < config.uni_churn) {
+    return false;
+  }
+
+  if (config.segment_size) {
+    return std::all_of(std::begin(downloads_), std::end(downloads_),
+                       [](const auto &d) { return d.done && !d.ninflight; });
+  }
+
+  return nstreams_done_ == config.nstreams &&
+         nstreams_closed_ == nstreams_done_;
+}
+
+const RecvStats &Client::recv_stats() const { return rx_stats_; }
+
+const DownloadStats &Client::download_stats() const { return dl_stats_; }
+
+const UniChurnStats &Client::uni_churn_stats() const { return churn_stats_; }
+
+namespace {
+// start_connection creates a socket, and starts the connection of
+// |c| to |addr| and |port|.  The event loop of |c| drives the rest
+// of it.
+int start_connection(Client &c, const char *addr, const char *port,
+                     TLSClientContext &tls_ctx) {
+  Address remote_addr, local_addr;
+
+  auto fd = create_sock(remote_addr, addr, port);
+  if (fd == -1) {
+    return -1;
+  }
+
+#ifdef HAVE_LINUX_RTNETLINK_H
+  in_addr_union iau;
+
+  if (get_local_addr(iau, remote_addr) != 0) {
+    std::cerr << "Could not get local address" << std::endl;
+    close(fd);
+    return -1;
+  }
+
+  if (bind_addr(local_addr, fd, &iau, remote_addr.su.sa.sa_family) != 0) {
+    close(fd);
+    return -1;
+  }
+#else  // !HAVE_LINUX_RTNETLINK_H
+  if (connect_sock(local_addr, fd, remote_addr) != 0) {
+    close(fd);
+    return -1;
+  }
+#endif // !HAVE_LINUX_RTNETLINK_H
+
+  if (c.init(fd, local_addr, remote_addr, addr, port, tls_ctx) != 0) {
+    return -1;
+  }
+
+  // TODO Do we need this ?
+  if (auto rv = c.on_write(); rv != 0) {
+    return rv;
+  }
+
+  return 0;
+}
+} // namespace
+
+namespace {
+int run(Client &c, const char *addr, const char *port,
+        TLSClientContext &tls_ctx) {
+  if (auto rv = start_connection(c, addr, port, tls_ctx); rv != 0) {
+    return rv;
+  }
+
+  run_event_loop(EV_DEFAULT, config.event_loop);
+
+  return 0;
+}
+} // namespace
+
+namespace {
+// LoadWorker makes its share of the connections in load generation
+// mode on its own event loop in a dedicated thread.
+struct LoadWorker {
+  ~LoadWorker() {
+    clients.clear();
+    if (loop) {
+      ev_loop_destroy(loop);
+    }
+  }
+
+  struct ev_loop *loop;
+  // tls_ctx is not shared with the other workers, so that the
+  // threads do not contend for the locks inside TLS stack.  It must
+  // outlive clients.
+  TLSClientContext tls_ctx;
+  const char *addr;
+  const char *port;
+  // nconn is the number of connections that this worker makes.
+  size_t nconn;
+  // nstarted is the number of connections started so far.
+  size_t nstarted;
+  // concurrency is the maximum number of connections that this
+  // worker keeps open at the same time.
+  size_t concurrency;
+  // credit is the number of connections that the rate limit allows
+  // to start now.  It is only used if --load-rate is given.
+  size_t credit;
+  std::list<std::unique_ptr<Client>> clients;
+  LoadStats stats;
+  ev_timer ratetimer;
+  ev_check checkev;
+  ev_async stopev;
+  std::thread thread;
+};
+} // namespace
+
+namespace {
+// load_done returns true if all connections of |w| have finished.
+bool load_done(const LoadWorker *w) {
+  return w->nstarted == w->nconn && w->clients.empty();
+}
+} // namespace
+
+namespace {
+void load_start_connections(LoadWorker *w) {
+  while (w->nstarted < w->nconn && w->clients.size() < w->concurrency) {
+    if (config.load_rate) {
+      if (w->credit == 0) {
+        return;
+      }
+
+      --w->credit;
+    }
+
+    ++w->nstarted;
+
+    auto c = std::make_unique<Client>(w->loop, config.version, config.version);
+    c->set_load_stats(&w->stats);
+
+    if (start_connection(*c, w->addr, w->port, w->tls_ctx) != 0) {
+      ++w->stats.nconn_failed;
+      continue;
+    }
+
+    w->clients.push_back(std::move(c));
+  }
+
+  if (load_done(w)) {
+    ev_break(w->loop, EVBREAK_ALL);
+  }
+}
+} // namespace
+
+namespace {
+void loadratecb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto wk = static_cast<LoadWorker *>(w->data);
+
+  // A tick missed while the concurrency is exhausted is dropped, so
+  // that the rate is never exceeded.
+  wk->credit = 1;
+
+  load_start_connections(wk);
+}
+} // namespace
+
+namespace {
+// loadcheckcb deletes the clients whose connections have closed.  It
+// runs after all callbacks in a loop iteration, so no callback refers
+// to the deleted client.
+void loadcheckcb(struct ev_loop *loop, ev_check *w, int revents) {
+  auto wk = static_cast<LoadWorker *>(w->data);
+  auto closed = false;
+
+  for (auto it = std::begin(wk->clients); it != std::end(wk->clients);) {
+    auto &c = *it;
+
+    if (!c->disconnected()) {
+      ++it;
+      continue;
+    }
+
+    if (c->all_streams_closed()) {
+      ++wk->stats.nconn_done;
+    } else {
+      ++wk->stats.nconn_failed;
+    }
+
+    it = wk->clients.erase(it);
+    closed = true;
+  }
+
+  if (closed) {
+    load_start_connections(wk);
+  }
+}
+} // namespace
+
+namespace {
+void loadstopcb(struct ev_loop *loop, ev_async *w, int revents) {
+  ev_break(loop, EVBREAK_ALL);
+}
+} // namespace
+
+namespace {
+void loaddonecb(struct ev_loop *loop, ev_async *w, int revents) {
+  ev_break(loop, EVBREAK_ALL);
+}
+} // namespace
+
+namespace {
+void loadsiginthandler(struct ev_loop *loop, ev_signal *w, int revents) {
+  auto workers =
+      static_cast<std::vector<std::unique_ptr<LoadWorker>> *>(w->data);
+
+  for (auto &wk : *workers) {
+    ev_async_send(wk->loop, &wk->stopev);
+  }
+}
+} // namespace
+
+namespace {
+void add_recv_stats(RecvStats &dest, const RecvStats &src) {
+  dest.ncall += src.ncall;
+  dest.nfull += src.nfull;
+  dest.ndgram += src.ndgram;
+  dest.nseg += src.nseg;
+  dest.max_batch = std::max(dest.max_batch, src.max_batch);
+}
+} // namespace
+
+namespace {
+void add_download_stats(DownloadStats &dest, const DownloadStats &src) {
+  if (src.nbytes == 0) {
+    return;
+  }
+
+  if (dest.nbytes == 0) {
+    dest.first_ts = src.first_ts;
+  }
+
+  dest.nbytes += src.nbytes;
+  dest.last_ts = src.last_ts;
+}
+} // namespace
+
+namespace {
+void print_recv_stats(const RecvStats &st) {
+  std::cerr << "Receive stats: calls=" << st.ncall
+            << " full_batches=" << st.nfull << " datagrams=" << st.ndgram
+            << " packets=" << st.nseg << " max_batch=" << st.max_batch
+            << std::endl;
+}
+} // namespace
+
+namespace {
+// cpu_time returns user and system CPU time in |ru| in nanoseconds.
+uint64_t cpu_time(const rusage &ru) {
+  auto tv_nsec = [](const timeval &tv) {
+    return static_cast<uint64_t>(tv.tv_sec) * NGTCP2_SECONDS +
+           static_cast<uint64_t>(tv.tv_usec) * NGTCP2_MICROSECONDS;
+  };
+
+  return tv_nsec(ru.ru_utime) + tv_nsec(ru.ru_stime);
+}
+} // namespace
+
+namespace {
+// print_download_stats prints the goodput of the response bodies in
+// |st|.  |cpu| is the CPU time in nanoseconds that the process spent.
+void print_download_stats(const DownloadStats &st, uint64_t cpu) {
+  auto elapsed = st.last_ts - st.first_ts;
+  auto secs = static_cast<double>(elapsed) / NGTCP2_SECONDS;
+  auto mbps =
+      secs > 0 ? static_cast<double>(st.nbytes) * 8 / secs / 1'000'000 : 0.;
+  auto ns_per_byte =
+      st.nbytes ? static_cast<double>(cpu) / static_cast<double>(st.nbytes)
+                : 0.;
+
+  std::cerr << "Download stats: bytes=" << st.nbytes
+            << " elapsed=" << util::format_durationf(elapsed)
+            << " goodput=" << mbps << "Mbps"
+            << " cpu=" << util::format_durationf(cpu)
+            << " cpu_per_byte=" << ns_per_byte << "ns" << std::endl;
+}
+} // namespace
+
+namespace {
+void print_latency(const std::string_view &name, const LatencyHistogram &h) {
+  std::cerr << name << ": count=" << h.count()
+            << " min=" << util::format_durationf(h.min())
+            << " mean=" << util::format_durationf(h.mean())
+            << " p50=" << util::format_durationf(h.percentile(50))
+            << " p90=" << util::format_durationf(h.percentile(90))
+            << " p99=" << util::format_durationf(h.percentile(99))
+            << " p99.9=" << util::format_durationf(h.percentile(99.9))
+            << " max=" << util::format_durationf(h.max()) << std::endl;
+}
+} // namespace
 
-  if (auto rv = ngtcp2_conn_open_uni_stream(conn_, &ctrl_stream_id, nullptr);
-      rv != 0) {
-    std::cerr << "ngtcp2_conn_open_uni_stream: " << ngtcp2_strerror(rv)
-              << std::endl;
-    return -1;
-  }
+namespace {
+// print_uni_churn_stats prints the statistics of --uni-churn in |st|.
+void print_uni_churn_stats(const UniChurnStats &st) {
+  auto elapsed = st.last_ts > st.first_ts ? st.last_ts - st.first_ts : 0;
+  auto secs = static_cast<double>(elapsed) / NGTCP2_SECONDS;
+  auto rate = secs > 0 ? static_cast<double>(st.nclosed) / secs : 0.;
+
+  std::cerr << "Uni stream churn: opened=" << st.nopened
+            << " closed=" << st.nclosed
+            << " elapsed=" << util::format_durationf(elapsed)
+            << " rate=" << rate << "/s" << std::endl;
+
+  print_latency("Stream open latency", st.open_latency);
+
+  std::cerr << "MAX_STREAMS: frames=" << st.nmax_streams
+            << " bytes=" << st.max_streams_bytes << " bytes_per_stream="
+            << (st.nopened ? static_cast<double>(st.max_streams_bytes) /
+                                 static_cast<double>(st.nopened)
+                           : 0.)
+            << std::endl;
 
-  if (auto rv = nghttp3_conn_bind_control_stream(httpconn_, ctrl_stream_id);
-      rv != 0) {
-    std::cerr << "nghttp3_conn_bind_control_stream: " << nghttp3_strerror(rv)
-              << std::endl;
-    return -1;
-  }
+  std::cerr << "Stream memory: peak_open=" << st.peak_open
+            << " bytes=" << st.peak_mem << " bytes_per_stream="
+            << (st.peak_open ? st.peak_mem / st.peak_open : 0) << std::endl;
+}
+} // namespace
 
-  if (!config.quiet) {
-    fprintf(stderr, "http: control stream=%" PRIx64 "\n", ctrl_stream_id);
-  }
+namespace {
+void print_load_stats(const LoadStats &st, ngtcp2_duration elapsed) {
+  auto secs = static_cast<double>(elapsed) / NGTCP2_SECONDS;
 
-  int64_t qpack_enc_stream_id, qpack_dec_stream_id;
+  std::cerr << "Load stats: connections=" << st.nconn_done + st.nconn_failed
+            << " succeeded=" << st.nconn_done << " failed=" << st.nconn_failed
+            << " requests=" << st.completion.count()
+            << " elapsed=" << util::format_durationf(elapsed);
 
-  if (auto rv =
-          ngtcp2_conn_open_uni_stream(conn_, &qpack_enc_stream_id, nullptr);
-      rv != 0) {
-    std::cerr << "ngtcp2_conn_open_uni_stream: " << ngtcp2_strerror(rv)
-              << std::endl;
-    return -1;
+  if (secs > 0) {
+    std::cerr << " conn/s=" << static_cast<uint64_t>(st.nconn_done / secs)
+              << " req/s="
+              << static_cast<uint64_t>(
+                     static_cast<double>(st.completion.count()) / secs);
   }
 
-  if (auto rv =
-          ngtcp2_conn_open_uni_stream(conn_, &qpack_dec_stream_id, nullptr);
-      rv != 0) {
-    std::cerr << "ngtcp2_conn_open_uni_stream: " << ngtcp2_strerror(rv)
-              << std::endl;
-    return -1;
-  }
+  std::cerr << " bytes=" << st.nbytes;
 
-  if (auto rv = nghttp3_conn_bind_qpack_streams(httpconn_, qpack_enc_stream_id,
-                                                qpack_dec_stream_id);
-      rv != 0) {
-    std::cerr << "nghttp3_conn_bind_qpack_streams: " << nghttp3_strerror(rv)
-              << std::endl;
-    return -1;
+  if (secs > 0) {
+    std::cerr << " goodput="
+              << static_cast<double>(st.nbytes) * 8 / secs / 1'000'000
+              << "Mbps";
   }
 
-  if (!config.quiet) {
-    fprintf(stderr,
-            "http: QPACK streams encoder=%" PRIx64 " decoder=%" PRIx64 "\n",
-            qpack_enc_stream_id, qpack_dec_stream_id);
-  }
+  std::cerr << " 0rtt_attempted=" << st.nearly_data
+            << " 0rtt_accepted=" << st.nearly_data_accepted << std::endl;
 
-  return 0;
-}
+  std::cerr << "Handshake RTTs: 1rtt=" << st.handshake_rtts[0]
+            << " 2rtt=" << st.handshake_rtts[1]
+            << " 3rtt=" << st.handshake_rtts[2]
+            << " 4+rtt=" << st.handshake_rtts[3] << std::endl;
 
-const std::vector<uint32_t> &Client::get_offered_versions() const {
-  return offered_versions_;
+  print_latency("Handshake"sv, st.handshake);
+  print_latency("TTFB"sv, st.ttfb);
+  print_latency("Completion"sv, st.completion);
 }
+} // namespace
 
 namespace {
-int run(Client &c, const char *addr, const char *port,
-        TLSClientContext &tls_ctx) {
-  Address remote_addr, local_addr;
+// run_load makes config.load_connections connections to |addr| and
+// |port| from config.load_threads threads, and prints the latencies
+// when they have finished.  Each thread creates its own TLS context
+// from |private_key_file| and |cert_file|.
+int run_load(const char *addr, const char *port, const char *private_key_file,
+             const char *cert_file) {
+  std::vector<std::unique_ptr<LoadWorker>> workers;
+
+  auto nthreads = config.load_threads;
+
+  for (size_t i = 0; i < nthreads; ++i) {
+    auto w = std::make_unique<LoadWorker>();
+    w->loop = new_event_loop(config.event_loop);
+    if (!w->loop) {
+      std::cerr << "ev_loop_new: Could not create event loop" << std::endl;
+      return -1;
+    }
 
-  auto fd = create_sock(remote_addr, addr, port);
-  if (fd == -1) {
-    return -1;
-  }
+    if (w->tls_ctx.init(private_key_file, cert_file) != 0) {
+      return -1;
+    }
 
-#ifdef HAVE_LINUX_RTNETLINK_H
-  in_addr_union iau;
+    w->addr = addr;
+    w->port = port;
+    // Spread the remainders over the first workers.
+    w->nconn = config.load_connections / nthreads +
+               (i < config.load_connections % nthreads);
+    w->nstarted = 0;
+    w->concurrency = std::max(
+        config.load_concurrency / nthreads +
+            (i < config.load_concurrency % nthreads),
+        static_cast<size_t>(1));
+    w->credit = 1;
+
+    if (config.load_rate) {
+      auto interval =
+          static_cast<double>(nthreads) / static_cast<double>(config.load_rate);
+      ev_timer_init(&w->ratetimer, loadratecb, interval, interval);
+      w->ratetimer.data = w.get();
+      ev_timer_start(w->loop, &w->ratetimer);
+    }
 
-  if (get_local_addr(iau, remote_addr) != 0) {
-    std::cerr << "Could not get local address" << std::endl;
-    close(fd);
-    return -1;
-  }
+    ev_check_init(&w->checkev, loadcheckcb);
+    w->checkev.data = w.get();
+    ev_check_start(w->loop, &w->checkev);
 
-  if (bind_addr(local_addr, fd, &iau, remote_addr.su.sa.sa_family) != 0) {
-    close(fd);
-    return -1;
-  }
-#else  // !HAVE_LINUX_RTNETLINK_H
-  if (connect_sock(local_addr, fd, remote_addr) != 0) {
-    close(fd);
-    return -1;
+    ev_async_init(&w->stopev, loadstopcb);
+    ev_async_start(w->loop, &w->stopev);
+
+    workers.push_back(std::move(w));
   }
-#endif // !HAVE_LINUX_RTNETLINK_H
 
-  if (c.init(fd, local_addr, remote_addr, addr, port, tls_ctx) != 0) {
-    return -1;
+  // The default loop handles SIGINT while the workers run, and it
+  // returns when the last worker has finished.
+  auto loop = EV_DEFAULT;
+
+  ev_signal sigintev;
+  ev_signal_init(&sigintev, loadsiginthandler, SIGINT);
+  sigintev.data = &workers;
+  ev_signal_start(loop, &sigintev);
+
+  auto start_ts = util::timestamp(loop);
+
+  ev_async doneev;
+  ev_async_init(&doneev, loaddonecb);
+  ev_async_start(loop, &doneev);
+
+  std::atomic<size_t> nrunning = nthreads;
+
+  for (auto &w : workers) {
+    w->thread = std::thread([w = w.get(), loop, &nrunning, &doneev]() {
+      ev_now_update(w->loop);
+
+      load_start_connections(w);
+
+      // ev_break is lost if it is called before ev_run.
+      if (!load_done(w)) {
+        run_event_loop(w->loop, config.event_loop);
+      }
+
+      // Close the remaining connections if interrupted.
+      w->clients.clear();
+
+      if (--nrunning == 0) {
+        ev_async_send(loop, &doneev);
+      }
+    });
   }
 
-  // TODO Do we need this ?
-  if (auto rv = c.on_write(); rv != 0) {
-    return rv;
+  run_event_loop(loop, config.event_loop);
+
+  ev_async_stop(loop, &doneev);
+  ev_signal_stop(loop, &sigintev);
+
+  LoadStats st{};
+
+  for (auto &w : workers) {
+    w->thread.join();
+
+    auto &wst = w->stats;
+    st.handshake.merge(wst.handshake);
+    st.ttfb.merge(wst.ttfb);
+    st.completion.merge(wst.completion);
+    st.nconn_done += wst.nconn_done;
+    st.nconn_failed += wst.nconn_failed;
+    st.nearly_data += wst.nearly_data;
+    st.nearly_data_accepted += wst.nearly_data_accepted;
+    for (size_t i = 0; i < st.handshake_rtts.size(); ++i) {
+      st.handshake_rtts[i] += wst.handshake_rtts[i];
+    }
+    st.nbytes += wst.nbytes;
   }
 
-  ev_run(EV_DEFAULT, 0);
+  print_load_stats(st, util::timestamp(loop) - start_ts);
 
   return 0;
 }
@@ -2228,9 +3648,14 @@ void config_set_default(Config &config) {
   config.max_window = 6_m;
   config.max_stream_window = 6_m;
   config.max_streams_uni = 100;
+  config.uni_churn_rate = 1000;
   config.cc_algo = NGTCP2_CC_ALGO_CUBIC;
+  config.pto_probe_policy = NGTCP2_PTO_PROBE_POLICY_NEW_DATA_FIRST;
   config.initial_rtt = NGTCP2_DEFAULT_INITIAL_RTT;
   config.handshake_timeout = NGTCP2_DEFAULT_HANDSHAKE_TIMEOUT;
+  config.load_concurrency = 16;
+  config.load_threads = 1;
+  config.recv_batch = 1;
 }
 } // namespace
 
@@ -2254,6 +3679,26 @@ Options:
               The probability of losing incoming packets.  <P> must be
               [0.0, 1.0],  inclusive.  0.0 means no  packet loss.  1.0
               means 100% packet loss.
+  --netem=<SPEC>
+              Send packets through a link emulated in the process.  It
+              needs no root privileges.  <SPEC> is a comma separated
+              list of <KEY>=<VALUE>:
+                delay=<DURATION>  one-way delay
+                jitter=<DURATION> maximum deviation from the delay
+                rate=<SIZE>       bandwidth in bytes per second
+                limit=<SIZE>      bytes waiting for the link before
+                                  the tail is dropped
+                loss=<P>          random loss
+                ge=<P>/<R>[/<LB>[/<LG>]]
+                                  Gilbert-Elliott loss.  <P> and <R>
+                                  are the probabilities of entering
+                                  and leaving the bad state.  <LB>
+                                  (default: 1.0) and <LG> (default:
+                                  0.0) are the loss in the bad and
+                                  the good state.
+                reorder=<P>       probability of skipping the delay
+                seed=<N>          seed of random number generator
+              Example: "delay=25ms,jitter=2ms,rate=1250K,limit=64K"
   -d, --data=<PATH>
               Read data from <PATH>, and send them as STREAM data.
   -n, --nstreams=<N>
@@ -2309,6 +3754,50 @@ Options:
               Read/write QUIC transport parameters from/to <PATH>.  To
               send 0-RTT data, the  transport parameters received from
               the previous session must be supplied with this option.
+  --path-cache-file=<PATH>
+              Read/write the congestion  control state of the paths
+              from/to  <PATH>.   The  state  is  keyed  by  the  /24
+              (IPv4) or /48 (IPv6) prefix  of the server address, and
+              it is shared by the  connections in load generation mode.
+              A new connection  to a known path  skips slow start with
+              Careful  Resume  if  --cc  is  reno,  cubic,  or  prague.
+              The entries expire after 10 minutes.
+  --resumption-cache-file=<PATH>
+              Read/write the TLS sessions, the tokens from NEW_TOKEN
+              frame, and the transport parameters for 0-RTT from/to
+              <PATH>.  They are keyed by the authority (host:port) of
+              the server.   Unlike --session-file, --token-file, and
+              --tp-file,  every connection  updates  them  in  load
+              generation mode, so that the  later connections resume
+              with what the earlier  ones have learned.  Only OpenSSL
+              and  BoringSSL  backends  cache  the  TLS  sessions.  The
+              entries expire after 1 hour.
+  --uni-churn=<N>
+              Open <N> short-lived unidirectional streams after the
+              handshake completes at the rate of --uni-churn-rate, and
+              print the stream open latency, the overhead of
+              MAX_STREAMS frames, and the memory per open stream when
+              client exits.  Each stream carries a few bytes of the
+              reserved stream type, which HTTP/3 server discards.  The
+              server must allow more unidirectional streams than the 3
+              which HTTP/3 uses, e.g., --max-streams-uni=100.
+  --uni-churn-rate=<RATE>
+              The number of the streams of --uni-churn to open per
+              second.
+              Default: )"
+            << config.uni_churn_rate << R"(
+  --segment-size=<SIZE>
+              Fetch each requested object once in the segments of
+              <SIZE> bytes by the range requests over as many streams
+              as the server allows, instead of opening -n streams.
+              The segments are requested in round robin across the
+              objects.  The first segment of an object is requested
+              alone until its response tells the length.  If --download
+              is given, the segments are written to the file at their
+              offsets by a background thread as they arrive.  The
+              throughput of each stream is printed when it closes.  If
+              the server ignores the range, the whole object is
+              fetched on a single stream.
   --dcid=<DCID>
               Specify  initial  DCID.   <DCID> is  hex  string.   When
               decoded as binary, it should be  at least 8 bytes and at
@@ -2357,6 +3846,64 @@ Options:
               file name  of each qlog  is the Source Connection  ID of
               client.   This  option   and  --qlog-file  are  mutually
               exclusive.
+  --qlog-compress
+              Compress qlog with gzip.  ".gz" is appended to the file
+              name.  The client must be built with zlib.
+  --qlog-ring=<SIZE>
+              Instead of writing a file for each connection, write qlog
+              into a  memory-mapped ring file  of <SIZE> bytes  for each
+              thread  under  --qlog-dir.   The  oldest  records  are
+              overwritten, so that  the rings keep the  latest qlog of
+              all connections.   Dump them  with qlogring.   This option
+              and --qlog-compress are mutually exclusive.
+  --verify-checksum
+              Compute  the checksum  of  a  response  body,  and compare
+              it with x-ngtcp2-checksum trailer field which server sends
+              with --dyn-pattern.  A mismatch is printed to stderr.
+  --load-connections=<N>
+              Enable load generation mode, and make <N> connections in
+              total.  Each connection makes the requests given in the
+              command line, and closes when all of them have completed.
+              The latencies of the handshake, the time to first byte,
+              and the completion of requests are printed out when all
+              connections have finished.  With --session-file and
+              --tp-file, the connections resume the session and
+              attempt 0RTT with the files written by a preceding run
+              without load generation mode.  The files are not written
+              in this mode.  -q is implied.
+  --load-concurrency=<N>
+              The maximum number of connections which are open at the
+              same time in load generation mode.
+              Default: )"
+            << config.load_concurrency << R"(
+  --load-threads=<N>
+              The number of threads which make connections in load
+              generation mode.  Each thread runs its own event loop
+              and TLS context.  The threads share the cache given by
+              --resumption-cache-file.
+              Default: )"
+            << config.load_threads << R"(
+  --load-rate=<N>
+              Start at most <N> connections per second in load
+              generation mode.  If 0 is given, a connection is started
+              as soon as --load-concurrency allows.
+              Default: )"
+            << config.load_rate << R"(
+  --recv-batch=<N>
+              Maximum number of UDP datagrams  that are received in a
+              single recvmmsg call.  If 1  is given, recvmsg is used.
+              The counters  of receive  path are  printed out  when
+              client exits.
+              Default: )"
+            << config.recv_batch << R"(
+  --gro       Enable UDP_GRO  so that  the kernel  coalesces incoming
+              datagrams.   Each  segment is  processed  as a  separate
+              packet.
+  --bench-download
+              Discard response  bodies as soon as  they are received
+              without  passing them  to HTTP/3  stack,  and print  the
+              goodput and  CPU time spent  per byte  when client exits.
+              Response headers and trailers are not processed.
   --max-data=<SIZE>
               The initial connection-level flow control window.
               Default: )"
@@ -2391,7 +3938,7 @@ Options:
               Exit when all client initiated HTTP streams are closed.
   --disable-early-data
               Disable early data.
-  --cc=(cubic|reno|bbr|bbr2)
+  --cc=(cubic|reno|bbr|bbr2|prague)
               The name of congestion controller algorithm.
               Default: )"
             << util::strccalgo(config.cc_algo) << R"(
@@ -2424,6 +3971,32 @@ Options:
               Default: )"
             << util::format_duration(config.handshake_timeout) << R"(
   --no-pmtud  Disables Path MTU Discovery.
+  --spin-bit  Enables the  latency spin bit, so that  on-path observers
+              can measure RTT passively.  It is still disabled for 1 in
+              16 connections at random.
+  --pto-probe-policy=<POLICY>
+              Specify what a PTO probe packet carries.  <POLICY> is one
+              of  "new-data-first",  which  sends  new  data  first,
+              "retransmit-oldest",  which  retransmits  the  oldest
+              in-flight packet  first, and  "duplicate-latest", which
+              retransmits the latest in-flight packet first.
+              Default: new-data-first
+  --pmtud-search
+              Find the path MTU by  binary search up to the size given
+              by --max-udp-payload-size, trying  the MTUs of Ethernet
+              and jumbo frames first.  With this option,
+              --max-udp-payload-size does not  disable the shaping of
+              UDP payload size to the discovered path MTU.
+  --event-loop=<BACKEND>
+              The backend of  the event loops: auto, select, poll,
+              epoll, kqueue, port, linuxaio, or io_uring.  It must be
+              supported by  libev and the kernel.   auto lets libev
+              choose.
+              Default: auto
+  --event-loop-busy-poll
+              Poll the backend of the event loops  without blocking
+              instead of sleeping until an event arrives.  It lowers
+              the wake-up latency at the cost of a busy CPU core.
   -h, --help  Display this help and exit.
 
 ---
@@ -2500,6 +4073,27 @@ int main(int argc, char **argv) {
         {"other-versions", required_argument, &flag, 37},
         {"no-pmtud", no_argument, &flag, 38},
         {"preferred-versions", required_argument, &flag, 39},
+        {"qlog-compress", no_argument, &flag, 40},
+        {"verify-checksum", no_argument, &flag, 41},
+        {"load-connections", required_argument, &flag, 42},
+        {"load-concurrency", required_argument, &flag, 43},
+        {"load-threads", required_argument, &flag, 44},
+        {"load-rate", required_argument, &flag, 45},
+        {"recv-batch", required_argument, &flag, 46},
+        {"gro", no_argument, &flag, 47},
+        {"bench-download", no_argument, &flag, 48},
+        {"pmtud-search", no_argument, &flag, 49},
+        {"path-cache-file", required_argument, &flag, 50},
+        {"event-loop", required_argument, &flag, 51},
+        {"event-loop-busy-poll", no_argument, &flag, 52},
+        {"netem", required_argument, &flag, 53},
+        {"resumption-cache-file", required_argument, &flag, 54},
+        {"segment-size", required_argument, &flag, 55},
+        {"uni-churn", required_argument, &flag, 56},
+        {"uni-churn-rate", required_argument, &flag, 57},
+        {"spin-bit", no_argument, &flag, 58},
+        {"pto-probe-policy", required_argument, &flag, 59},
+        {"qlog-ring", required_argument, &flag, 60},
         {nullptr, 0, nullptr, 0},
     };
 
@@ -2757,7 +4351,12 @@ int main(int argc, char **argv) {
           config.cc_algo = NGTCP2_CC_ALGO_BBR2;
           break;
         }
-        std::cerr << "cc: specify cubic, reno, bbr, or bbr2" << std::endl;
+        if (strcmp("prague", optarg) == 0) {
+          config.cc_algo = NGTCP2_CC_ALGO_PRAGUE;
+          break;
+        }
+        std::cerr << "cc: specify cubic, reno, bbr, bbr2, or prague"
+                  << std::endl;
         exit(EXIT_FAILURE);
       case 28:
         // --exit-on-all-streams-close
@@ -2896,6 +4495,167 @@ int main(int argc, char **argv) {
         }
         break;
       }
+      case 40:
+        // --qlog-compress
+        config.qlog_compress = true;
+        break;
+      case 41:
+        // --verify-checksum
+        config.verify_checksum = true;
+        break;
+      case 42:
+        // --load-connections
+        if (auto n = util::parse_uint(optarg); !n) {
+          std::cerr << "load-connections: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.load_connections = *n;
+        }
+        break;
+      case 43:
+        // --load-concurrency
+        if (auto n = util::parse_uint(optarg); !n || *n == 0) {
+          std::cerr << "load-concurrency: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.load_concurrency = *n;
+        }
+        break;
+      case 44:
+        // --load-threads
+        if (auto n = util::parse_uint(optarg); !n || *n == 0) {
+          std::cerr << "load-threads: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.load_threads = *n;
+        }
+        break;
+      case 45:
+        // --load-rate
+        if (auto n = util::parse_uint(optarg); !n) {
+          std::cerr << "load-rate: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.load_rate = *n;
+        }
+        break;
+      case 46:
+        // --recv-batch
+        if (auto n = util::parse_uint(optarg); !n || *n == 0) {
+          std::cerr << "recv-batch: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else if (*n > 1024) {
+          std::cerr << "recv-batch: must not exceed 1024" << std::endl;
+          exit(EXIT_FAILURE);
+#ifndef HAVE_RECVMMSG
+        } else if (*n > 1) {
+          std::cerr << "recv-batch: recvmmsg is not available" << std::endl;
+          exit(EXIT_FAILURE);
+#endif // !defined(HAVE_RECVMMSG)
+        } else {
+          config.recv_batch = *n;
+        }
+        break;
+      case 47:
+        // --gro
+        config.gro = true;
+        break;
+      case 48:
+        // --bench-download
+        config.bench_download = true;
+        break;
+      case 49:
+        // --pmtud-search
+        config.pmtud_search = true;
+        break;
+      case 50:
+        // --path-cache-file
+        config.path_cache_file = optarg;
+        break;
+      case 51:
+        // --event-loop
+        if (auto b = parse_event_loop_backend(optarg); !b) {
+          std::cerr << "event-loop: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.event_loop.backend = *b;
+        }
+        break;
+      case 52:
+        // --event-loop-busy-poll
+        config.event_loop.busy_poll = true;
+        break;
+      case 53:
+        // --netem
+        if (auto c = parse_netem_config(optarg); !c) {
+          std::cerr << "netem: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.netem = *c;
+        }
+        break;
+      case 54:
+        // --resumption-cache-file
+        config.resumption_cache_file = optarg;
+        break;
+      case 55:
+        // --segment-size
+        if (auto n = util::parse_uint_iec(optarg); !n || *n == 0) {
+          std::cerr << "segment-size: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.segment_size = *n;
+        }
+        break;
+      case 56:
+        // --uni-churn
+        if (auto n = util::parse_uint(optarg); !n) {
+          std::cerr << "uni-churn: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.uni_churn = *n;
+        }
+        break;
+      case 57:
+        // --uni-churn-rate
+        if (auto n = util::parse_uint(optarg); !n || *n == 0) {
+          std::cerr << "uni-churn-rate: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.uni_churn_rate = *n;
+        }
+        break;
+      case 58:
+        // --spin-bit
+        config.spin_bit = true;
+        break;
+      case 59:
+        // --pto-probe-policy
+        if (strcmp("new-data-first", optarg) == 0) {
+          config.pto_probe_policy = NGTCP2_PTO_PROBE_POLICY_NEW_DATA_FIRST;
+          break;
+        }
+        if (strcmp("retransmit-oldest", optarg) == 0) {
+          config.pto_probe_policy = NGTCP2_PTO_PROBE_POLICY_RETRANSMIT_OLDEST;
+          break;
+        }
+        if (strcmp("duplicate-latest", optarg) == 0) {
+          config.pto_probe_policy = NGTCP2_PTO_PROBE_POLICY_DUPLICATE_LATEST;
+          break;
+        }
+        std::cerr << "pto-probe-policy: specify new-data-first, "
+                     "retransmit-oldest, or duplicate-latest"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+      case 60:
+        // --qlog-ring
+        if (auto n = util::parse_uint_iec(optarg); !n || *n == 0) {
+          std::cerr << "qlog-ring: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.qlog_ring_size = *n;
+        }
+        break;
       }
       break;
     default:
@@ -2914,6 +4674,18 @@ int main(int argc, char **argv) {
     exit(EXIT_FAILURE);
   }
 
+  if (config.qlog_ring_size) {
+    if (config.qlog_dir.empty()) {
+      std::cerr << "qlog-ring: requires qlog-dir" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    if (config.qlog_compress) {
+      std::cerr << "qlog-ring and qlog-compress are mutually exclusive"
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
   if (config.exit_on_first_stream_close && config.exit_on_all_streams_close) {
     std::cerr << "exit-on-first-stream-close and exit-on-all-streams-close are "
                  "mutually exclusive"
@@ -2976,15 +4748,55 @@ int main(int argc, char **argv) {
     config.nstreams = config.requests.size();
   }
 
+  if (config.segment_size && config.bench_download) {
+    std::cerr << "segment-size: --bench-download is not supported"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (config.load_connections) {
+    if (config.tx_loss_prob != 0) {
+      std::cerr << "load-connections: --tx-loss is not supported" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    if (config.bench_download) {
+      std::cerr << "load-connections: --bench-download is not supported"
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    if (config.segment_size) {
+      std::cerr << "load-connections: --segment-size is not supported"
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    if (config.uni_churn) {
+      std::cerr << "load-connections: --uni-churn is not supported"
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    config.quiet = true;
+    config.exit_on_first_stream_close = false;
+    config.exit_on_all_streams_close = true;
+    config.load_threads =
+        std::min(config.load_threads, config.load_connections);
+  }
+
   TLSClientContext tls_ctx;
   if (tls_ctx.init(private_key_file, cert_file) != 0) {
     exit(EXIT_FAILURE);
   }
 
+  if (!init_default_event_loop(config.event_loop)) {
+    std::cerr << "ev_default_loop: Could not create event loop" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
   auto ev_loop_d = defer(ev_loop_destroy, EV_DEFAULT);
 
   auto keylog_filename = getenv("SSLKEYLOGFILE");
-  if (keylog_filename) {
+  // keylog_file is not shared by the threads in load generation mode.
+  if (keylog_filename && !config.load_connections) {
     keylog_file.open(keylog_filename, std::ios_base::app);
     if (keylog_file) {
       tls_ctx.enable_keylog();
@@ -2997,8 +4809,86 @@ int main(int argc, char **argv) {
     exit(EXIT_FAILURE);
   }
 
+  // Declared before Client, so that it outlives all of them.
+  QlogSink qs;
+
+  if (config.qlog_ring_size) {
+    if (qs.start_ring(std::string{config.qlog_dir}, config.qlog_ring_size) !=
+        0) {
+      exit(EXIT_FAILURE);
+    }
+
+    qlog_sink = &qs;
+  } else if (!config.qlog_file.empty() || !config.qlog_dir.empty()) {
+    if (qs.start(config.qlog_compress) != 0) {
+      exit(EXIT_FAILURE);
+    }
+
+    qlog_sink = &qs;
+  }
+
+  // Declared before Client, so that it outlives all of them.
+  PathCache pc;
+
+  if (config.path_cache_file) {
+    // The file does not exist on the first run.
+    pc.load(config.path_cache_file);
+
+    path_cache = &pc;
+  }
+
+  auto pc_d = defer([&pc]() {
+    if (config.path_cache_file && pc.save(config.path_cache_file) != 0) {
+      std::cerr << "Could not write path cache in " << config.path_cache_file
+                << std::endl;
+    }
+  });
+
+  ResumptionCache rc;
+
+  if (config.resumption_cache_file) {
+    // The file does not exist on the first run.
+    rc.load(config.resumption_cache_file);
+
+    resumption_cache = &rc;
+  }
+
+  auto rc_d = defer([&rc]() {
+    if (config.resumption_cache_file &&
+        rc.save(config.resumption_cache_file) != 0) {
+      std::cerr << "Could not write resumption cache in "
+                << config.resumption_cache_file << std::endl;
+    }
+  });
+
+  // Declared before Client, so that it outlives all of them.
+  FileWriter fw;
+
+  if (config.segment_size && !config.download.empty()) {
+    if (fw.start() != 0) {
+      exit(EXIT_FAILURE);
+    }
+
+    file_writer = &fw;
+  }
+
+  if (config.load_connections) {
+    if (run_load(addr, port, private_key_file, cert_file) != 0) {
+      exit(EXIT_FAILURE);
+    }
+
+    return EXIT_SUCCESS;
+  }
+
   auto client_chosen_version = config.version;
 
+  RecvStats rst{};
+  DownloadStats dst{};
+  UniChurnStats ust{};
+  rusage ru_start;
+
+  getrusage(RUSAGE_SELF, &ru_start);
+
   for (;;) {
     Client c(EV_DEFAULT, client_chosen_version, config.version);
 
@@ -3006,6 +4896,12 @@ int main(int argc, char **argv) {
       exit(EXIT_FAILURE);
     }
 
+    add_recv_stats(rst, c.recv_stats());
+    add_download_stats(dst, c.download_stats());
+    // Only the last connection, which is not closed by version
+    // negotiation, opens the streams of --uni-churn.
+    ust = c.uni_churn_stats();
+
     if (config.preferred_versions.empty()) {
       break;
     }
@@ -3030,5 +4926,32 @@ int main(int argc, char **argv) {
     }
   }
 
+  if (file_writer) {
+    // Wait for the segments to be written.
+    fw.stop();
+
+    if (fw.nerrors()) {
+      std::cerr << "Could not write " << fw.nerrors() << " segment(s)"
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (config.recv_batch > 1 || config.gro) {
+    print_recv_stats(rst);
+  }
+
+  if (config.uni_churn) {
+    print_uni_churn_stats(ust);
+  }
+
+  if (config.bench_download) {
+    rusage ru_end;
+
+    getrusage(RUSAGE_SELF, &ru_end);
+
+    print_download_stats(dst, cpu_time(ru_end) - cpu_time(ru_start));
+  }
+
   return EXIT_SUCCESS;
 }
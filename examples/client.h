@@ -32,8 +32,10 @@
 #include <vector>
 #include <deque>
 #include <map>
+#include <unordered_set>
 #include <string_view>
 #include <memory>
+#include <array>
 
 #include <ngtcp2/ngtcp2.h>
 #include <ngtcp2/ngtcp2_crypto.h>
@@ -47,9 +49,33 @@
 #include "network.h"
 #include "shared.h"
 #include "template.h"
+#include "dyn_pattern.h"
+#include "latency_histogram.h"
 
 using namespace ngtcp2;
 
+// Download is an object which is fetched in the segments of
+// --segment-size bytes by the range requests over the concurrent
+// streams.
+struct Download {
+  Request req;
+  // fd is the file which the segments are written to, or -1.  It is
+  // closed by FileWriter after the last segment.
+  int fd;
+  // length is the length of the object.  It is UINT64_MAX until the
+  // first response tells it.
+  uint64_t length;
+  // next_offset is the offset of the next segment to request.
+  uint64_t next_offset;
+  // ninflight is the number of the streams which are fetching the
+  // segments.
+  size_t ninflight;
+  // done is true if no more segment is requested.
+  bool done;
+  // failed is true if a segment could not be fetched.
+  bool failed;
+};
+
 struct Stream {
   Stream(const Request &req, int64_t stream_id);
   ~Stream();
@@ -59,6 +85,100 @@ struct Stream {
   Request req;
   int64_t stream_id;
   int fd;
+  // checksum is DynChecksum of the response body received so far.
+  DynChecksum checksum;
+  // request_ts is the timestamp when the request was submitted.
+  ngtcp2_tstamp request_ts;
+  // response_started is true if the response header fields have
+  // started to arrive.
+  bool response_started;
+  // download, if not nullptr, is the object whose segment this
+  // stream fetches.
+  Download *download;
+  // offset is the offset of the segment in the object.
+  uint64_t offset;
+  // seglen is the length of the segment.  It is UINT64_MAX if the
+  // server sends the whole object.
+  uint64_t seglen;
+  // nbytes is the number of bytes of the segment received so far.
+  uint64_t nbytes;
+  // status_code is the status code of the response.
+  unsigned int status_code;
+  // content_range is the value of content-range header field.
+  std::string content_range;
+  // segment_ok is true if the response carries the requested
+  // segment.
+  bool segment_ok;
+};
+
+// DownloadStats is the statistics of --bench-download.
+struct DownloadStats {
+  // nbytes is the number of bytes received on request streams.
+  uint64_t nbytes;
+  // first_ts is the timestamp when the first byte was received.
+  ngtcp2_tstamp first_ts;
+  // last_ts is the timestamp when the last byte was received.
+  ngtcp2_tstamp last_ts;
+};
+
+// UniChurnStats is the statistics of --uni-churn.
+struct UniChurnStats {
+  // nopened is the number of unidirectional streams opened.
+  size_t nopened;
+  // nclosed is the number of those streams closed.
+  size_t nclosed;
+  // open_latency is the time from when a stream is due to when it is
+  // opened.  It grows if the streams are opened faster than peer
+  // raises the limit with MAX_STREAMS frame.
+  LatencyHistogram open_latency;
+  // nmax_streams is the number of MAX_STREAMS frames which raised
+  // the limit of the unidirectional streams.
+  size_t nmax_streams;
+  // max_streams_bytes is the number of bytes of those frames.
+  uint64_t max_streams_bytes;
+  // peak_open is the largest number of the streams open at the same
+  // time.
+  size_t peak_open;
+  // peak_mem is the number of bytes that the connection allocated
+  // beyond those before the first stream was opened when peak_open
+  // streams were open.
+  uint64_t peak_mem;
+  // first_ts is the timestamp when the first stream was opened.
+  ngtcp2_tstamp first_ts;
+  // last_ts is the timestamp when the last stream was closed.
+  ngtcp2_tstamp last_ts;
+};
+
+// LoadStats is the statistics of the connections that a thread makes
+// in load generation mode.  The latencies are in nanoseconds.
+struct LoadStats {
+  // handshake is the time from the start of a connection to the
+  // completion of the handshake.
+  LatencyHistogram handshake;
+  // ttfb is the time from the submission of a request to the first
+  // byte of its response header fields.
+  LatencyHistogram ttfb;
+  // completion is the time from the submission of a request to the
+  // close of its stream.
+  LatencyHistogram completion;
+  // nconn_done is the number of connections whose requests have all
+  // completed.
+  size_t nconn_done;
+  // nconn_failed is the number of connections which were closed
+  // before all of their requests completed.
+  size_t nconn_failed;
+  // nearly_data is the number of connections which attempted 0RTT.
+  size_t nearly_data;
+  // nearly_data_accepted is the number of connections whose 0RTT was
+  // accepted.
+  size_t nearly_data_accepted;
+  // handshake_rtts is the number of connections by the number of
+  // round trips their handshake took.  The last element counts 4 or
+  // more round trips.  A compressed certificate chain which fits in
+  // the server's amplification limit saves a round trip.
+  std::array<size_t, 4> handshake_rtts;
+  // nbytes is the number of bytes of the response bodies received.
+  uint64_t nbytes;
 };
 
 class Client;
@@ -81,6 +201,10 @@ public:
   void disconnect();
 
   int on_read(const Endpoint &ep);
+  int on_read_single(const Endpoint &ep);
+  int on_read_batch(const Endpoint &ep);
+  int on_read_msg(const Endpoint &ep, msghdr *msg, uint8_t *data,
+                  size_t datalen);
   int on_write();
   int write_streams();
   int feed_data(const Endpoint &ep, const sockaddr *sa, socklen_t salen,
@@ -93,8 +217,29 @@ public:
 
   int send_packet(const Endpoint &ep, const ngtcp2_addr &remote_addr,
                   unsigned int ecn, const uint8_t *data, size_t datalen);
+  // send_packet_now sends |data| of length |datalen| to the network
+  // bypassing the emulated link.
+  int send_packet_now(const Endpoint &ep, const ngtcp2_addr &remote_addr,
+                      unsigned int ecn, const uint8_t *data, size_t datalen);
+  // update_netem_timer arms the ev_timer to the time when the next
+  // packet leaves the emulated link.
+  void update_netem_timer();
+  // on_netem sends the packets which have left the emulated link.
+  void on_netem();
   int on_stream_close(int64_t stream_id, uint64_t app_error_code);
   int on_extend_max_streams();
+  // on_extend_max_streams_uni is called when the limit of the local
+  // unidirectional streams is raised to |max_streams|.
+  int on_extend_max_streams_uni(uint64_t max_streams);
+  // on_uni_churn schedules the streams of --uni-churn which are due
+  // now.
+  void on_uni_churn();
+  // open_churn_streams opens the streams of --uni-churn which are
+  // due as long as the limit allows.
+  void open_churn_streams();
+  // add_churn_write_offset records that |datalen| bytes of the first
+  // stream in the write queue of --uni-churn have been written.
+  void add_churn_write_offset(size_t datalen);
   int handle_error();
   int make_stream_early();
   int change_local_addr();
@@ -104,6 +249,7 @@ public:
                  ngtcp2_crypto_aead_ctx *tx_aead_ctx, uint8_t *tx_iv,
                  const uint8_t *current_rx_secret,
                  const uint8_t *current_tx_secret, size_t secretlen);
+  void release_aead_ctx(ngtcp2_crypto_aead_ctx *aead_ctx);
   int initiate_key_update();
   void start_key_update_timer();
   void start_delay_stream_timer();
@@ -116,12 +262,23 @@ public:
   void set_remote_addr(const ngtcp2_addr &remote_addr);
 
   int setup_httpconn();
+  // submit_segments opens the streams to fetch the segments of
+  // downloads_ in round robin.
+  int submit_segments();
   int submit_http_request(const Stream *stream);
   int recv_stream_data(uint32_t flags, int64_t stream_id, const uint8_t *data,
                        size_t datalen);
   int acked_stream_data_offset(int64_t stream_id, uint64_t datalen);
   void http_consume(int64_t stream_id, size_t nconsumed);
   void http_write_data(int64_t stream_id, const uint8_t *data, size_t datalen);
+  void http_verify_checksum(int64_t stream_id, const std::string_view &value);
+  void http_begin_headers(int64_t stream_id);
+  void http_recv_header(int64_t stream_id, int32_t token,
+                        const nghttp3_vec &name, const nghttp3_vec &value);
+  void http_end_headers(int64_t stream_id);
+  // close_segment records the end of the segment that |stream|
+  // fetches.
+  void close_segment(const Stream &stream, uint64_t app_error_code);
   int on_stream_reset(int64_t stream_id);
   int on_stream_stop_sending(int64_t stream_id);
   int extend_max_stream_data(int64_t stream_id, uint64_t max_data);
@@ -136,6 +293,16 @@ public:
 
   const std::vector<uint32_t> &get_offered_versions() const;
 
+  // set_load_stats makes this client record its latencies in |st|.
+  void set_load_stats(LoadStats *st);
+  // disconnected returns true if the connection has been closed.
+  bool disconnected() const;
+  // all_streams_closed returns true if all requests have completed.
+  bool all_streams_closed() const;
+  const RecvStats &recv_stats() const;
+  const DownloadStats &download_stats() const;
+  const UniChurnStats &uni_churn_stats() const;
+
 private:
   std::vector<Endpoint> endpoints_;
   Address remote_addr_;
@@ -157,8 +324,20 @@ private:
   size_t nstreams_done_;
   // nstreams_closed_ is the number of streams get closed.
   size_t nstreams_closed_;
+  // downloads_ is the objects fetched in segments if --segment-size
+  // is given.
+  std::vector<Download> downloads_;
+  // next_download_ is the index of downloads_ which the next segment
+  // is requested from.
+  size_t next_download_;
+  // submit_segments_ is true if submit_segments should be called
+  // after the received data is processed.
+  bool submit_segments_;
   // nkey_update_ is the number of key update occurred.
   size_t nkey_update_;
+  // aead_ctx_pool_ recycles the AEAD contexts of 1RTT keys across key
+  // updates.
+  ngtcp2_crypto_aead_ctx_pool aead_ctx_pool_;
   uint32_t client_chosen_version_;
   uint32_t original_version_;
   // early_data_ is true if client attempts to do 0RTT data transfer.
@@ -169,6 +348,52 @@ private:
   // handshake_confirmed_ gets true after handshake has been
   // confirmed.
   bool handshake_confirmed_;
+  // start_ts_ is the timestamp when the connection started.
+  ngtcp2_tstamp start_ts_;
+  // load_stats_, if not nullptr, is where the latencies are recorded
+  // in load generation mode.
+  LoadStats *load_stats_;
+  RecvStats rx_stats_;
+  DownloadStats dl_stats_;
+  UniChurnStats churn_stats_;
+
+  struct {
+    // timer schedules the streams at --uni-churn-rate.
+    ev_timer timer;
+    // start_ts is the timestamp when timer was started.
+    ngtcp2_tstamp start_ts;
+    // nscheduled is the number of the streams which have become due.
+    size_t nscheduled;
+    // due is the timestamps when the streams which are not opened yet
+    // became due.
+    std::deque<ngtcp2_tstamp> due;
+    // open is the IDs of the open streams.
+    std::unordered_set<int64_t> open;
+    // tx is the IDs of the streams whose data has not been written
+    // yet.
+    std::deque<int64_t> tx;
+    // txoff is the number of bytes written to the first stream in
+    // tx.
+    size_t txoff;
+    // max_streams is the current limit of the local unidirectional
+    // streams.
+    uint64_t max_streams;
+    // mem_base is the number of bytes that the connection allocated
+    // before the first stream was opened.
+    uint64_t mem_base;
+  } churn_;
+
+  struct {
+    // data is the buffer which receives config.recv_batch datagrams.
+    // It is allocated only if config.recv_batch > 1.
+    std::unique_ptr<uint8_t[]> data;
+#ifdef HAVE_RECVMMSG
+    std::vector<mmsghdr> msgs;
+    std::vector<iovec> iovs;
+    std::vector<sockaddr_union> addrs;
+    std::vector<uint8_t> ctrl;
+#endif // HAVE_RECVMMSG
+  } rx_;
 
   struct {
     bool send_blocked;
@@ -181,6 +406,14 @@ private:
     } blocked;
     std::array<uint8_t, 64_k> data;
   } tx_;
+
+  struct {
+    // link emulates the network link which the outgoing packets go
+    // through if --netem is given.
+    std::unique_ptr<NetEm> link;
+    // timer is armed to the time when the next packet leaves link.
+    ev_timer timer;
+  } netem_;
 };
 
 #endif // CLIENT_H
@@ -28,6 +28,8 @@
 #include <array>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <chrono>
 
 #include "debug.h"
 #include "template.h"
@@ -43,7 +45,12 @@ static ngtcp2_conn *get_conn(ngtcp2_crypto_conn_ref *conn_ref) {
 }
 
 ClientBase::ClientBase()
-    : conn_ref_{get_conn, this}, qlog_(nullptr), conn_(nullptr) {
+    : conn_ref_{get_conn, this},
+      qlog_(nullptr),
+      qlog_sink_(nullptr),
+      qlog_file_(nullptr),
+      conn_(nullptr),
+      resumption_cache_(nullptr) {
   ngtcp2_connection_close_error_default(&last_error_);
 }
 
@@ -55,6 +62,10 @@ ClientBase::~ClientBase() {
   if (qlog_) {
     fclose(qlog_);
   }
+
+  if (qlog_file_) {
+    qlog_sink_->close(qlog_file_);
+  }
 }
 
 int ClientBase::write_transport_params(const char *path,
@@ -64,6 +75,20 @@ int ClientBase::write_transport_params(const char *path,
     return -1;
   }
 
+  if (write_transport_params(f, params) != 0) {
+    return -1;
+  }
+
+  f.close();
+  if (!f) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int ClientBase::write_transport_params(std::ostream &f,
+                                       const ngtcp2_transport_params *params) {
   f << "initial_max_streams_bidi=" << params->initial_max_streams_bidi << '\n'
     << "initial_max_streams_uni=" << params->initial_max_streams_uni << '\n'
     << "initial_max_stream_data_bidi_local="
@@ -77,12 +102,7 @@ int ClientBase::write_transport_params(const char *path,
     << '\n'
     << "max_datagram_frame_size=" << params->max_datagram_frame_size << '\n';
 
-  f.close();
-  if (!f) {
-    return -1;
-  }
-
-  return 0;
+  return f ? 0 : -1;
 }
 
 int ClientBase::read_transport_params(const char *path,
@@ -92,6 +112,11 @@ int ClientBase::read_transport_params(const char *path,
     return -1;
   }
 
+  return read_transport_params(f, params);
+}
+
+int ClientBase::read_transport_params(std::istream &f,
+                                      ngtcp2_transport_params *params) {
   for (std::string line; std::getline(f, line);) {
     if (util::istarts_with_l(line, "initial_max_streams_bidi=")) {
       if (auto n = util::parse_uint(line.c_str() +
@@ -187,6 +212,62 @@ int ClientBase::read_transport_params(const char *path,
 
 ngtcp2_conn *ClientBase::conn() const { return conn_; }
 
+namespace {
+// wallclock_now returns the current wall-clock time in nanoseconds,
+// which ResumptionCache uses so that its file ages across runs.
+ngtcp2_tstamp wallclock_now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+} // namespace
+
+ResumptionCache *ClientBase::resumption_cache() const {
+  return resumption_cache_;
+}
+
+std::optional<ResumptionState> ClientBase::get_resumption_state() const {
+  if (!resumption_cache_) {
+    return {};
+  }
+
+  return resumption_cache_->get(authority_, wallclock_now());
+}
+
+void ClientBase::store_session(std::string session) {
+  if (resumption_cache_) {
+    resumption_cache_->put_session(authority_, std::move(session),
+                                   wallclock_now());
+  }
+}
+
+void ClientBase::store_token(std::string token) {
+  if (resumption_cache_) {
+    resumption_cache_->put_token(authority_, std::move(token),
+                                 wallclock_now());
+  }
+}
+
+void ClientBase::store_transport_params(
+    const ngtcp2_transport_params *params) {
+  if (!resumption_cache_) {
+    return;
+  }
+
+  std::ostringstream f;
+
+  if (write_transport_params(f, params) != 0) {
+    return;
+  }
+
+  resumption_cache_->put_transport_params(authority_, f.str(),
+                                          wallclock_now());
+}
+
+bool should_write_session_file() {
+  return config.session_file && !config.load_connections;
+}
+
 void qlog_write_cb(void *user_data, uint32_t flags, const void *data,
                    size_t datalen) {
   auto c = static_cast<ClientBase *>(user_data);
@@ -194,6 +275,11 @@ void qlog_write_cb(void *user_data, uint32_t flags, const void *data,
 }
 
 void ClientBase::write_qlog(const void *data, size_t datalen) {
+  if (qlog_file_) {
+    qlog_sink_->write(qlog_file_, data, datalen);
+    return;
+  }
+
   assert(qlog_);
   fwrite(data, 1, datalen, qlog_);
 }
@@ -34,12 +34,19 @@
 #include <string>
 #include <string_view>
 #include <functional>
+#include <optional>
+#include <istream>
+#include <ostream>
 
 #include <ngtcp2/ngtcp2_crypto.h>
 
 #include "tls_client_session.h"
 #include "network.h"
 #include "shared.h"
+#include "event_loop.h"
+#include "qlog_sink.h"
+#include "netem.h"
+#include "resumption_cache.h"
 
 using namespace ngtcp2;
 
@@ -57,6 +64,9 @@ struct Config {
   double tx_loss_prob;
   // rx_loss_prob is probability of losing incoming packet.
   double rx_loss_prob;
+  // netem is the configuration of the emulated network link which
+  // outgoing packets go through.
+  std::optional<NetEmConfig> netem;
   // fd is a file descriptor to read input for streams.
   int fd;
   // ciphers is the list of enabled ciphers.
@@ -115,6 +125,11 @@ struct Config {
   // qlog_dir is the path to directory where qlog is stored.  qlog_dir
   // and qlog_file are mutually exclusive.
   std::string_view qlog_dir;
+  // qlog_compress is true if qlog is gzip compressed.
+  bool qlog_compress;
+  // qlog_ring_size, if nonzero, is the size of the ring file which
+  // each thread writes qlog into.
+  size_t qlog_ring_size;
   // max_data is the initial connection-level flow control window.
   uint64_t max_data;
   // max_stream_data_bidi_local is the initial stream-level flow
@@ -178,6 +193,62 @@ struct Config {
   std::vector<uint32_t> other_versions;
   // no_pmtud disables Path MTU Discovery.
   bool no_pmtud;
+  // pmtud_search makes Path MTU Discovery bisect UDP payload size up
+  // to max_udp_payload_size.
+  bool pmtud_search;
+  // spin_bit enables the latency spin bit.
+  bool spin_bit;
+  // pto_probe_policy is the policy which decides what a PTO probe
+  // packet carries.
+  ngtcp2_pto_probe_policy pto_probe_policy;
+  // verify_checksum is true if the body of a response is checked
+  // against x-ngtcp2-checksum trailer field.
+  bool verify_checksum;
+  // load_connections is the number of connections to make in load
+  // generation mode.  If it is 0, load generation mode is disabled.
+  size_t load_connections;
+  // load_concurrency is the maximum number of connections which are
+  // open at the same time in load generation mode.
+  size_t load_concurrency;
+  // load_threads is the number of threads which make connections in
+  // load generation mode.
+  size_t load_threads;
+  // load_rate is the number of connections started per second in load
+  // generation mode.  If it is 0, a connection is started as soon as
+  // load_concurrency allows.
+  size_t load_rate;
+  // recv_batch is the maximum number of UDP datagrams that are
+  // received in a single recvmmsg call.  If it is 1, recvmsg is used
+  // instead.
+  size_t recv_batch;
+  // gro is true if UDP_GRO is enabled so that the kernel coalesces
+  // incoming datagrams.
+  bool gro;
+  // bench_download is true if the response bodies are discarded in
+  // recv_stream_data callback without being passed to HTTP/3 stack,
+  // and the download throughput is printed out on exit.
+  bool bench_download;
+  // path_cache_file is a path to a file to write, and read the
+  // congestion control state of the paths.
+  const char *path_cache_file;
+  // resumption_cache_file is a path to a file to write, and read the
+  // TLS sessions, tokens, and transport parameters of the servers.
+  const char *resumption_cache_file;
+  // segment_size, if nonzero, is the length of the segments which
+  // the requested objects are fetched in by the range requests over
+  // the concurrent streams.
+  size_t segment_size;
+  // uni_churn is the number of the short-lived unidirectional
+  // streams to open after the handshake completes.
+  size_t uni_churn;
+  // uni_churn_rate is the number of the streams of uni_churn to open
+  // per second.
+  size_t uni_churn_rate;
+  // bench_connections is the number of connections which h09client
+  // makes in parallel.
+  size_t bench_connections;
+  // event_loop selects the backend of the event loops.
+  EventLoopConfig event_loop;
 };
 
 class ClientBase {
@@ -189,7 +260,20 @@ public:
 
   int write_transport_params(const char *path,
                              const ngtcp2_transport_params *params);
+  int write_transport_params(std::ostream &f,
+                             const ngtcp2_transport_params *params);
   int read_transport_params(const char *path, ngtcp2_transport_params *params);
+  int read_transport_params(std::istream &f, ngtcp2_transport_params *params);
+
+  // resumption_cache returns the cache which this client shares with
+  // the others, or nullptr.
+  ResumptionCache *resumption_cache() const;
+  // get_resumption_state returns the state cached for the authority
+  // of this client.
+  std::optional<ResumptionState> get_resumption_state() const;
+  void store_session(std::string session);
+  void store_token(std::string token);
+  void store_transport_params(const ngtcp2_transport_params *params);
 
   void write_qlog(const void *data, size_t datalen);
 
@@ -199,11 +283,28 @@ protected:
   ngtcp2_crypto_conn_ref conn_ref_;
   TLSClientSession tls_session_;
   FILE *qlog_;
+  // qlog_sink_ and qlog_file_, if set, write qlog in the background
+  // instead of qlog_.
+  QlogSink *qlog_sink_;
+  QlogFile *qlog_file_;
   ngtcp2_conn *conn_;
   ngtcp2_connection_close_error last_error_;
+  // resumption_cache_, if set, remembers the resumption state of
+  // authority_, which is host:port of the server.
+  ResumptionCache *resumption_cache_;
+  std::string authority_;
 };
 
 void qlog_write_cb(void *user_data, uint32_t flags, const void *data,
                    size_t datalen);
 
+// should_write_session_file returns true if the TLS backend should
+// write a new TLS session to config.session_file.  It returns false
+// if config.session_file is not set, because the new session callback
+// is also installed for config.resumption_cache_file.  In load
+// generation mode, the connections only read the session file, which
+// a preceding run has written, so that the concurrent connections
+// never see a half-written file.
+bool should_write_session_file();
+
 #endif // CLIENT_BASE_H
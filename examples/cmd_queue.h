@@ -0,0 +1,198 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef CMD_QUEUE_H
+#define CMD_QUEUE_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <ev.h>
+
+#include <ngtcp2/ngtcp2.h>
+
+namespace ngtcp2 {
+
+// MPSCQueue is a lock-free multi producer single consumer queue.
+// push can be called from any thread, and pop only from the consumer
+// thread.  push allocates a node, and never waits for the other
+// threads.  pop may not see the element whose push has not returned
+// yet.  The producer should wake up the consumer after push returns
+// so that the consumer pops it then.  T must be default
+// constructible.
+template <typename T> class MPSCQueue {
+public:
+  MPSCQueue() : head_{&stub_}, tail_{&stub_} {}
+  MPSCQueue(const MPSCQueue &) = delete;
+  ~MPSCQueue() {
+    T v;
+
+    while (pop(v))
+      ;
+
+    if (tail_ != &stub_) {
+      delete tail_;
+    }
+  }
+
+  MPSCQueue &operator=(const MPSCQueue &) = delete;
+
+  void push(T v) {
+    auto node = new Node;
+    node->value = std::move(v);
+
+    auto prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  // pop moves the oldest element to |v|, and returns true.  It
+  // returns false if the queue is empty.
+  bool pop(T &v) {
+    auto tail = tail_;
+    auto next = tail->next.load(std::memory_order_acquire);
+    if (!next) {
+      return false;
+    }
+
+    // next becomes the new stub node.
+    v = std::move(next->value);
+    tail_ = next;
+
+    if (tail != &stub_) {
+      delete tail;
+    }
+
+    return true;
+  }
+
+private:
+  struct Node {
+    std::atomic<Node *> next{nullptr};
+    T value;
+  };
+
+  // head_ is the node pushed last.  It is written by producers, and
+  // kept apart from tail_ which the consumer writes.
+  alignas(64) std::atomic<Node *> head_;
+  alignas(64) Node *tail_;
+  Node stub_;
+};
+
+enum class StreamCommandType {
+  // WRITE appends data to a stream.
+  WRITE,
+  // CLOSE resets a stream.
+  CLOSE,
+};
+
+// StreamCommand is an operation on a stream which a thread other than
+// the owner of ngtcp2_conn requests.
+struct StreamCommand {
+  StreamCommandType type;
+  // cid is a Connection ID of the connection.
+  ngtcp2_cid cid;
+  int64_t stream_id;
+  // data is the data to write.
+  std::vector<uint8_t> data;
+  // fin is true if WRITE ends the stream.
+  bool fin;
+  // app_error_code is the application error code which CLOSE resets
+  // the stream with.
+  uint64_t app_error_code;
+};
+
+// CommandQueue carries StreamCommand from the application threads to
+// the I/O thread of a worker which owns the connections.  The wakeups
+// are batched: only the push which finds the queue idle signals the
+// event loop of the I/O thread.  The callback of the I/O thread calls
+// drain to apply all commands at once, and then writes the packets of
+// the connections that the commands touched.
+class CommandQueue {
+public:
+  CommandQueue() = default;
+  CommandQueue(const CommandQueue &) = delete;
+
+  CommandQueue &operator=(const CommandQueue &) = delete;
+
+  // start makes |loop| call |cb| after commands are pushed.  |data|
+  // is assigned to ev_async.data.
+  void start(struct ev_loop *loop,
+             void (*cb)(struct ev_loop *, ev_async *, int), void *data) {
+    loop_ = loop;
+    ev_async_init(&async_, cb);
+    async_.data = data;
+    ev_async_start(loop_, &async_);
+  }
+
+  // stop stops the watcher started by start.
+  void stop() {
+    if (loop_) {
+      ev_async_stop(loop_, &async_);
+      loop_ = nullptr;
+    }
+  }
+
+  // push queues |cmd|.  It can be called from any thread.
+  void push(StreamCommand cmd) {
+    q_.push(std::move(cmd));
+
+    if (!signaled_.exchange(true, std::memory_order_acq_rel)) {
+      ev_async_send(loop_, &async_);
+    }
+  }
+
+  // drain calls |f| with each queued command in the order of push for
+  // each producer.  It returns the number of commands.  It must be
+  // called from the I/O thread.
+  template <typename F> size_t drain(F &&f) {
+    // Clear the flag before popping so that a command pushed after
+    // this point signals again.  The exchange synchronizes with the
+    // producer which set the flag, so that its command is seen.
+    signaled_.exchange(false, std::memory_order_acq_rel);
+
+    size_t n = 0;
+
+    for (StreamCommand cmd; q_.pop(cmd); ++n) {
+      f(cmd);
+    }
+
+    return n;
+  }
+
+private:
+  MPSCQueue<StreamCommand> q_;
+  std::atomic<bool> signaled_{false};
+  struct ev_loop *loop_ = nullptr;
+  ev_async async_;
+};
+
+} // namespace ngtcp2
+
+#endif // CMD_QUEUE_H
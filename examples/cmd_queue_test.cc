@@ -0,0 +1,159 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "cmd_queue_test.h"
+
+#include <array>
+#include <memory>
+#include <thread>
+
+#include <CUnit/CUnit.h>
+
+#include "cmd_queue.h"
+
+namespace ngtcp2 {
+
+void test_mpsc_queue() {
+  MPSCQueue<std::unique_ptr<int>> q;
+  std::unique_ptr<int> v;
+
+  CU_ASSERT(!q.pop(v));
+
+  q.push(std::make_unique<int>(1));
+  q.push(std::make_unique<int>(2));
+
+  CU_ASSERT(q.pop(v));
+  CU_ASSERT(1 == *v);
+
+  q.push(std::make_unique<int>(3));
+
+  CU_ASSERT(q.pop(v));
+  CU_ASSERT(2 == *v);
+  CU_ASSERT(q.pop(v));
+  CU_ASSERT(3 == *v);
+  CU_ASSERT(!q.pop(v));
+
+  // The destructor frees the elements left.
+  q.push(std::make_unique<int>(4));
+}
+
+void test_mpsc_queue_threads() {
+  constexpr size_t nproducer = 4;
+  constexpr uint64_t n = 10000;
+  MPSCQueue<uint64_t> q;
+  std::array<std::thread, nproducer> producers;
+
+  for (size_t i = 0; i < nproducer; ++i) {
+    producers[i] = std::thread([&q, i] {
+      for (uint64_t j = 0; j < n; ++j) {
+        q.push((i << 32) | j);
+      }
+    });
+  }
+
+  // The elements of a producer come out in order.
+  std::array<uint64_t, nproducer> next{};
+  uint64_t v;
+
+  for (size_t npopped = 0; npopped < nproducer * n;) {
+    if (!q.pop(v)) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    auto i = v >> 32;
+
+    CU_ASSERT(next[i] == (v & 0xffffffffu));
+
+    ++next[i];
+    ++npopped;
+  }
+
+  for (auto &t : producers) {
+    t.join();
+  }
+
+  CU_ASSERT(!q.pop(v));
+}
+
+namespace {
+struct BatchLog {
+  CommandQueue *q;
+  size_t ncall;
+  size_t ncmd;
+  uint64_t last_error_code;
+};
+} // namespace
+
+namespace {
+void cmdcb(struct ev_loop *loop, ev_async *w, int revents) {
+  auto log = static_cast<BatchLog *>(w->data);
+
+  ++log->ncall;
+  log->ncmd += log->q->drain([log](StreamCommand &cmd) {
+    log->last_error_code = cmd.app_error_code;
+  });
+}
+} // namespace
+
+void test_cmd_queue_batch() {
+  auto loop = ev_loop_new(0);
+  CommandQueue q;
+  BatchLog log{
+      .q = &q,
+  };
+
+  q.start(loop, cmdcb, &log);
+
+  for (uint64_t i = 0; i < 3; ++i) {
+    q.push({
+        .type = StreamCommandType::CLOSE,
+        .stream_id = 0,
+        .app_error_code = i,
+    });
+  }
+
+  ev_run(loop, EVRUN_NOWAIT);
+
+  // The commands pushed before the loop runs are drained at once.
+  CU_ASSERT(1 == log.ncall);
+  CU_ASSERT(3 == log.ncmd);
+  CU_ASSERT(2 == log.last_error_code);
+
+  q.push({
+      .type = StreamCommandType::WRITE,
+      .stream_id = 4,
+      .data = {'a'},
+  });
+
+  ev_run(loop, EVRUN_NOWAIT);
+
+  CU_ASSERT(2 == log.ncall);
+  CU_ASSERT(4 == log.ncmd);
+
+  q.stop();
+  ev_loop_destroy(loop);
+}
+
+} // namespace ngtcp2
@@ -0,0 +1,1068 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef CORO_H
+#define CORO_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <coroutine>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <ngtcp2/ngtcp2.h>
+
+// This header wraps ngtcp2_conn with C++20 coroutines.  A coroutine
+// which returns Task can co_await the events of a connection and its
+// streams instead of spreading its logic over the callbacks:
+//
+//   Task echo(Connection &c) {
+//     auto stream = co_await c.accept();
+//     for (;;) {
+//       auto r = co_await stream.read();
+//       if (co_await stream.write(r.data) != 0 || r.fin || r.reset) {
+//         break;
+//       }
+//     }
+//     stream.finish();
+//   }
+//
+// The application still owns the event loop.  It calls
+// ngtcp2_conn_read_pkt, and then Connection::resume_ready to run the
+// coroutines whose events have happened, and Connection::write_pkt to
+// send packets.  The callbacks only record the events, so that the
+// coroutines never run inside them.
+//
+// The awaiters live in the coroutine frames, and waiting for an event
+// allocates nothing.  The received data and the data to send are
+// copied into the per stream buffers whose memory is recycled.
+
+namespace ngtcp2 {
+
+namespace coro {
+
+class Connection;
+struct StreamState;
+
+// Task is the return type of a coroutine which is driven by
+// Connection.  The coroutine starts running when it is called, and its
+// frame is owned by Task.  Destroying Task which is suspended cancels
+// the coroutine.
+class Task {
+public:
+  struct promise_type {
+    Task get_return_object() {
+      return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+
+  Task() = default;
+  Task(const Task &) = delete;
+  Task(Task &&other) noexcept : h_{std::exchange(other.h_, nullptr)} {}
+  ~Task() { reset(); }
+
+  Task &operator=(const Task &) = delete;
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      reset();
+      h_ = std::exchange(other.h_, nullptr);
+    }
+
+    return *this;
+  }
+
+  // done returns true if the coroutine has returned.
+  bool done() const { return !h_ || h_.done(); }
+
+private:
+  explicit Task(std::coroutine_handle<promise_type> h) : h_{h} {}
+
+  void reset() {
+    if (h_) {
+      h_.destroy();
+      h_ = nullptr;
+    }
+  }
+
+  std::coroutine_handle<promise_type> h_;
+};
+
+// Waiter is a coroutine which waits for an event.  It is a part of an
+// awaiter, and lives in the coroutine frame.
+struct Waiter {
+  std::coroutine_handle<> h;
+  // slot points to the pointer which refers to this object while it
+  // waits for the event.
+  Waiter **slot = nullptr;
+  // prev and next link the waiters which are ready to resume.
+  Waiter *prev = nullptr;
+  Waiter *next = nullptr;
+  bool ready = false;
+};
+
+// StreamChunk is a piece of the send buffer of a stream.  ngtcp2 refers
+// to the data which is sent until it is acknowledged, so that the data
+// must never move.
+struct StreamChunk {
+  std::array<uint8_t, 16384> data;
+};
+
+// StreamState is the state of a stream which Connection keeps.
+struct StreamState {
+  Connection *conn;
+  int64_t stream_id;
+  // rbuf is the data which is received, but not read yet.
+  std::vector<uint8_t> rbuf;
+  // rview is the data which the last read returned.
+  std::vector<uint8_t> rview;
+  // chunks is the send buffer.  chunks.front() starts at the offset
+  // base.
+  std::deque<std::unique_ptr<StreamChunk>> chunks;
+  uint64_t base = 0;
+  // end is the offset of the end of the buffered data.
+  uint64_t end = 0;
+  // sent is the offset of the data which is passed to ngtcp2 next.
+  uint64_t sent = 0;
+  // acked is the offset up to which the data is acknowledged.
+  uint64_t acked = 0;
+  uint64_t app_error_code = 0;
+  Waiter *reader = nullptr;
+  Waiter *writer = nullptr;
+  // wdata points to the data which the writer has not buffered yet.
+  std::span<const uint8_t> *wdata = nullptr;
+  // rfin is true if the peer finished sending.
+  bool rfin = false;
+  // reset is true if the stream is reset before rfin.
+  bool reset = false;
+  // fin is true if the application finished writing.
+  bool fin = false;
+  bool fin_sent = false;
+  bool shut_wr = false;
+  // blocked is true if the stream is blocked by the stream level flow
+  // control.
+  bool blocked = false;
+  // queued is true if the stream is in Connection::sendq_.
+  bool queued = false;
+  bool closed = false;
+  // attached is true if Stream or the accept queue refers to this
+  // object.
+  bool attached = true;
+};
+
+// ReadResult is the result of Stream::read.
+struct ReadResult {
+  // data is the received data.  It is valid until the next read.
+  std::span<const uint8_t> data;
+  // fin is true if the peer sends no more data.
+  bool fin;
+  // reset is true if the stream is reset or closed before the peer
+  // finished sending.
+  bool reset;
+};
+
+// AwaiterBase removes the waiter from Connection when the awaiter is
+// destroyed, so that a cancelled coroutine is never resumed.
+class AwaiterBase {
+public:
+  explicit AwaiterBase(Connection &conn) : conn_{conn} {}
+  AwaiterBase(const AwaiterBase &) = delete;
+  ~AwaiterBase();
+
+  AwaiterBase &operator=(const AwaiterBase &) = delete;
+
+protected:
+  Connection &conn_;
+  Waiter waiter_;
+};
+
+class ReadAwaiter : public AwaiterBase {
+public:
+  explicit ReadAwaiter(StreamState &s);
+
+  bool await_ready() const noexcept {
+    return !s_.rbuf.empty() || s_.rfin || s_.reset;
+  }
+  void await_suspend(std::coroutine_handle<> h);
+  ReadResult await_resume();
+
+private:
+  StreamState &s_;
+};
+
+class WriteAwaiter : public AwaiterBase {
+public:
+  WriteAwaiter(StreamState &s, std::span<const uint8_t> data);
+  ~WriteAwaiter();
+
+  bool await_ready();
+  void await_suspend(std::coroutine_handle<> h);
+  // await_resume returns 0 if all data is buffered, or
+  // NGTCP2_ERR_STREAM_SHUT_WR.
+  int await_resume();
+
+private:
+  StreamState &s_;
+  std::span<const uint8_t> data_;
+};
+
+// Stream is the handle of a stream.  Destroying Stream before the
+// stream is finished in both directions shuts down the rest of the
+// stream.  Stream must outlive the awaiters which it returns.
+class Stream {
+public:
+  Stream() = default;
+  explicit Stream(StreamState *s) : s_{s} {}
+  Stream(const Stream &) = delete;
+  Stream(Stream &&other) noexcept : s_{std::exchange(other.s_, nullptr)} {}
+  ~Stream() { detach(); }
+
+  Stream &operator=(const Stream &) = delete;
+  Stream &operator=(Stream &&other) noexcept {
+    if (this != &other) {
+      detach();
+      s_ = std::exchange(other.s_, nullptr);
+    }
+
+    return *this;
+  }
+
+  explicit operator bool() const { return s_ != nullptr; }
+
+  int64_t id() const { return s_->stream_id; }
+
+  // read waits for the data from the peer.  The flow control credit
+  // is returned to the peer when the data is read.
+  ReadAwaiter read() { return ReadAwaiter{*s_}; }
+  // write copies |data| into the send buffer.  It waits while the
+  // buffer is full.
+  WriteAwaiter write(std::span<const uint8_t> data) {
+    return WriteAwaiter{*s_, data};
+  }
+  // finish tells that the application writes no more data.
+  void finish();
+  // reset abandons the stream with |app_error_code|.
+  void reset(uint64_t app_error_code);
+
+private:
+  void detach();
+
+  StreamState *s_ = nullptr;
+};
+
+class HandshakeAwaiter : public AwaiterBase {
+public:
+  using AwaiterBase::AwaiterBase;
+
+  bool await_ready() const noexcept;
+  void await_suspend(std::coroutine_handle<> h);
+  // await_resume returns true if the handshake has completed.
+  bool await_resume() const noexcept;
+};
+
+class OpenAwaiter : public AwaiterBase {
+public:
+  OpenAwaiter(Connection &conn, bool bidi)
+      : AwaiterBase{conn}, bidi_{bidi} {}
+
+  bool await_ready();
+  void await_suspend(std::coroutine_handle<> h);
+  // await_resume returns the opened stream.  It returns the empty
+  // Stream if the connection is shut down.
+  Stream await_resume();
+
+private:
+  StreamState *s_ = nullptr;
+  bool bidi_;
+};
+
+class AcceptAwaiter : public AwaiterBase {
+public:
+  using AwaiterBase::AwaiterBase;
+
+  bool await_ready() const noexcept;
+  void await_suspend(std::coroutine_handle<> h);
+  // await_resume returns the stream which the peer opened.  It
+  // returns the empty Stream if the connection is shut down.
+  Stream await_resume();
+};
+
+// Connection owns ngtcp2_conn, and runs the coroutines which wait for
+// its events.  At most one coroutine can wait for each kind of event
+// of a connection or a stream at a time.  Task must be destroyed
+// before Connection.
+class Connection {
+public:
+  Connection() = default;
+  Connection(const Connection &) = delete;
+  ~Connection() {
+    streams_.clear();
+    ngtcp2_conn_del(conn_);
+  }
+
+  Connection &operator=(const Connection &) = delete;
+
+  // set_callbacks sets the stream callbacks to |callbacks|.  The
+  // user_data passed to ngtcp2_conn_client_new or
+  // ngtcp2_conn_server_new must be the pointer to Connection.  The
+  // other callbacks are left untouched.
+  static void set_callbacks(ngtcp2_callbacks &callbacks) {
+    callbacks.handshake_completed = on_handshake_completed;
+    callbacks.recv_stream_data = on_recv_stream_data;
+    callbacks.acked_stream_data_offset = on_acked_stream_data_offset;
+    callbacks.stream_open = on_stream_open;
+    callbacks.stream_close = on_stream_close;
+    callbacks.stream_reset = on_stream_reset;
+    callbacks.extend_max_local_streams_bidi = on_extend_max_local_streams_bidi;
+    callbacks.extend_max_local_streams_uni = on_extend_max_local_streams_uni;
+    callbacks.extend_max_stream_data = on_extend_max_stream_data;
+  }
+
+  // attach makes this object own |conn|.
+  void attach(ngtcp2_conn *conn) {
+    assert(!conn_);
+    conn_ = conn;
+  }
+
+  ngtcp2_conn *conn() const { return conn_; }
+
+  // set_send_buffer_size sets the maximum number of bytes which a
+  // stream buffers until they are acknowledged.
+  void set_send_buffer_size(size_t n) { sbuf_limit_ = n; }
+
+  HandshakeAwaiter handshake() { return HandshakeAwaiter{*this}; }
+  OpenAwaiter open_bidi_stream() { return OpenAwaiter{*this, true}; }
+  OpenAwaiter open_uni_stream() { return OpenAwaiter{*this, false}; }
+  AcceptAwaiter accept() { return AcceptAwaiter{*this}; }
+
+  // resume_ready resumes the coroutines whose events have happened.
+  // Call it outside the callbacks after the calls which may trigger
+  // the events, e.g., ngtcp2_conn_read_pkt, and then write packets.
+  void resume_ready() {
+    while (ready_head_) {
+      auto w = ready_head_;
+
+      unlink(*w);
+      w->h.resume();
+    }
+  }
+
+  // write_pkt writes a packet which carries the buffered stream data
+  // to |dest| of length |destlen|.  It returns the same values as
+  // ngtcp2_conn_writev_stream.  The streams are served in a round
+  // robin fashion.
+  ngtcp2_ssize write_pkt(ngtcp2_path *path, ngtcp2_pkt_info *pi,
+                         uint8_t *dest, size_t destlen, ngtcp2_tstamp ts);
+
+  // shutdown fails all pending and future operations so that the
+  // coroutines can finish.  Call it when the connection is closed.
+  void shutdown();
+
+  bool is_shutdown() const { return shutdown_; }
+
+  // find_stream returns the state of the stream |stream_id|, or
+  // nullptr if it does not exist.
+  StreamState *find_stream(int64_t stream_id) const {
+    auto it = streams_.find(stream_id);
+    if (it == std::end(streams_)) {
+      return nullptr;
+    }
+
+    return (*it).second.get();
+  }
+
+private:
+  friend class AwaiterBase;
+  friend class ReadAwaiter;
+  friend class WriteAwaiter;
+  friend class HandshakeAwaiter;
+  friend class OpenAwaiter;
+  friend class AcceptAwaiter;
+  friend class Stream;
+
+  static constexpr size_t CHUNK_SIZE = sizeof(StreamChunk::data);
+
+  void wait(Waiter &w, Waiter *&slot, std::coroutine_handle<> h) {
+    assert(!slot);
+
+    w.h = h;
+    w.slot = &slot;
+    slot = &w;
+  }
+
+  void wake(Waiter *&slot) {
+    auto w = slot;
+    if (!w) {
+      return;
+    }
+
+    slot = nullptr;
+    w->slot = nullptr;
+    w->ready = true;
+    w->prev = ready_tail_;
+    w->next = nullptr;
+
+    if (ready_tail_) {
+      ready_tail_->next = w;
+    } else {
+      ready_head_ = w;
+    }
+
+    ready_tail_ = w;
+  }
+
+  void unlink(Waiter &w) {
+    if (w.prev) {
+      w.prev->next = w.next;
+    } else {
+      ready_head_ = w.next;
+    }
+
+    if (w.next) {
+      w.next->prev = w.prev;
+    } else {
+      ready_tail_ = w.prev;
+    }
+
+    w.prev = w.next = nullptr;
+    w.ready = false;
+  }
+
+  void cancel(Waiter &w) {
+    if (w.slot) {
+      *w.slot = nullptr;
+      w.slot = nullptr;
+    }
+
+    if (w.ready) {
+      unlink(w);
+    }
+  }
+
+  StreamState *add_stream(int64_t stream_id) {
+    auto s = std::make_unique<StreamState>();
+    auto p = s.get();
+
+    p->conn = this;
+    p->stream_id = stream_id;
+
+    if (!ngtcp2_is_bidi_stream(stream_id)) {
+      if (ngtcp2_conn_is_local_stream(conn_, stream_id)) {
+        p->rfin = true;
+      } else {
+        p->fin = p->fin_sent = p->shut_wr = true;
+      }
+    }
+
+    ngtcp2_conn_set_stream_user_data(conn_, stream_id, p);
+
+    streams_.emplace(stream_id, std::move(s));
+
+    return p;
+  }
+
+  void erase_stream(StreamState &s) {
+    unqueue(s);
+
+    for (auto &c : s.chunks) {
+      free_chunks_.push_back(std::move(c));
+    }
+
+    if (!s.closed) {
+      ngtcp2_conn_set_stream_user_data(conn_, s.stream_id, nullptr);
+    }
+
+    streams_.erase(s.stream_id);
+  }
+
+  // detach is called when the handle of |s| is destroyed.
+  void detach(StreamState &s) {
+    s.attached = false;
+
+    if (s.closed || shutdown_) {
+      erase_stream(s);
+      return;
+    }
+
+    if (!s.fin) {
+      ngtcp2_conn_shutdown_stream(conn_, s.stream_id, 0);
+      s.fin = s.shut_wr = true;
+      unqueue(s);
+    } else if (!s.rfin) {
+      ngtcp2_conn_shutdown_stream_read(conn_, s.stream_id, 0);
+    }
+
+    consume(s, s.rbuf.size());
+    s.rbuf.clear();
+  }
+
+  // consume returns the flow control credit of |n| bytes read from
+  // |s| to the peer.
+  void consume(StreamState &s, size_t n) {
+    if (n == 0 || shutdown_) {
+      return;
+    }
+
+    ngtcp2_conn_extend_max_stream_offset(conn_, s.stream_id, n);
+    ngtcp2_conn_extend_max_offset(conn_, n);
+  }
+
+  bool sendable(const StreamState &s) const {
+    return !s.shut_wr && !s.blocked &&
+           (s.sent < s.end || (s.fin && !s.fin_sent));
+  }
+
+  void schedule(StreamState &s) {
+    if (s.queued || !sendable(s)) {
+      return;
+    }
+
+    s.queued = true;
+    sendq_.push_back(&s);
+  }
+
+  void unqueue(StreamState &s) {
+    if (!s.queued) {
+      return;
+    }
+
+    s.queued = false;
+    sendq_.erase(std::ranges::find(sendq_, &s));
+  }
+
+  // buffer copies |data| into the send buffer of |s| as long as it
+  // has room, and removes the copied part from |data|.
+  void buffer(StreamState &s, std::span<const uint8_t> &data) {
+    while (!data.empty() && s.end - s.acked < sbuf_limit_) {
+      auto used = static_cast<size_t>(s.end - s.base);
+      auto off = used % CHUNK_SIZE;
+
+      if (s.chunks.empty() || (off == 0 && used)) {
+        if (s.chunks.empty()) {
+          s.base = s.end;
+        }
+
+        if (free_chunks_.empty()) {
+          s.chunks.push_back(std::make_unique<StreamChunk>());
+        } else {
+          s.chunks.push_back(std::move(free_chunks_.back()));
+          free_chunks_.pop_back();
+        }
+
+        off = 0;
+      }
+
+      auto n = std::min({data.size(), CHUNK_SIZE - off,
+                         static_cast<size_t>(sbuf_limit_ - (s.end - s.acked))});
+
+      memcpy(s.chunks.back()->data.data() + off, data.data(), n);
+
+      s.end += n;
+      data = data.subspan(n);
+    }
+
+    schedule(s);
+  }
+
+  // fill_vec stores the buffered data of |s| which is not sent yet
+  // into |vec|.  It returns the number of the elements stored, and
+  // whether they cover all of the data.
+  std::pair<size_t, bool> fill_vec(std::span<ngtcp2_vec> vec,
+                                   const StreamState &s) const {
+    size_t n = 0;
+    auto off = s.sent;
+
+    for (; off < s.end && n < vec.size(); ++n) {
+      auto pos = static_cast<size_t>(off - s.base);
+      auto &c = s.chunks[pos / CHUNK_SIZE];
+      auto len = std::min(CHUNK_SIZE - pos % CHUNK_SIZE,
+                          static_cast<size_t>(s.end - off));
+
+      vec[n].base = c->data.data() + pos % CHUNK_SIZE;
+      vec[n].len = len;
+
+      off += len;
+    }
+
+    return {n, off == s.end};
+  }
+
+  void on_sent(StreamState &s, ngtcp2_ssize ndatalen, uint32_t flags) {
+    s.sent += static_cast<uint64_t>(ndatalen);
+
+    if ((flags & NGTCP2_WRITE_STREAM_FLAG_FIN) && s.sent == s.end) {
+      s.fin_sent = true;
+    }
+
+    // Move the stream to the back of the queue.
+    unqueue(s);
+    schedule(s);
+  }
+
+  static Connection *get(void *user_data) {
+    return static_cast<Connection *>(user_data);
+  }
+
+  static int on_handshake_completed(ngtcp2_conn *conn, void *user_data) {
+    auto c = get(user_data);
+
+    c->wake(c->handshake_waiter_);
+
+    return 0;
+  }
+
+  static int on_recv_stream_data(ngtcp2_conn *conn, uint32_t flags,
+                                 int64_t stream_id, uint64_t offset,
+                                 const uint8_t *data, size_t datalen,
+                                 void *user_data, void *stream_user_data) {
+    auto c = get(user_data);
+    auto s = static_cast<StreamState *>(stream_user_data);
+
+    if (!s || !s->attached) {
+      // Nobody reads the data.
+      ngtcp2_conn_extend_max_stream_offset(conn, stream_id, datalen);
+      ngtcp2_conn_extend_max_offset(conn, datalen);
+
+      return 0;
+    }
+
+    s->rbuf.insert(s->rbuf.end(), data, data + datalen);
+
+    if (flags & NGTCP2_STREAM_DATA_FLAG_FIN) {
+      s->rfin = true;
+    }
+
+    c->wake(s->reader);
+
+    return 0;
+  }
+
+  static int on_acked_stream_data_offset(ngtcp2_conn *conn, int64_t stream_id,
+                                         uint64_t offset, uint64_t datalen,
+                                         void *user_data,
+                                         void *stream_user_data) {
+    auto c = get(user_data);
+    auto s = static_cast<StreamState *>(stream_user_data);
+
+    if (!s) {
+      return 0;
+    }
+
+    // ngtcp2 reports the acknowledged data in order.
+    s->acked = offset + datalen;
+
+    while (!s->chunks.empty() && s->acked - s->base >= CHUNK_SIZE) {
+      c->free_chunks_.push_back(std::move(s->chunks.front()));
+      s->chunks.pop_front();
+      s->base += CHUNK_SIZE;
+    }
+
+    if (s->writer) {
+      c->buffer(*s, *s->wdata);
+
+      if (s->wdata->empty()) {
+        c->wake(s->writer);
+      }
+    }
+
+    return 0;
+  }
+
+  static int on_stream_open(ngtcp2_conn *conn, int64_t stream_id,
+                            void *user_data) {
+    auto c = get(user_data);
+
+    c->accept_q_.push_back(c->add_stream(stream_id));
+    c->wake(c->accept_waiter_);
+
+    return 0;
+  }
+
+  static int on_stream_close(ngtcp2_conn *conn, uint32_t flags,
+                             int64_t stream_id, uint64_t app_error_code,
+                             void *user_data, void *stream_user_data) {
+    auto c = get(user_data);
+    auto s = static_cast<StreamState *>(stream_user_data);
+
+    if (!s) {
+      return 0;
+    }
+
+    s->closed = s->shut_wr = true;
+
+    if (!s->rfin) {
+      s->reset = true;
+    }
+
+    if (flags & NGTCP2_STREAM_CLOSE_FLAG_APP_ERROR_CODE_SET) {
+      s->app_error_code = app_error_code;
+    }
+
+    c->unqueue(*s);
+    c->wake(s->reader);
+    c->wake(s->writer);
+
+    if (!s->attached) {
+      c->erase_stream(*s);
+    }
+
+    return 0;
+  }
+
+  static int on_stream_reset(ngtcp2_conn *conn, int64_t stream_id,
+                             uint64_t final_size, uint64_t app_error_code,
+                             void *user_data, void *stream_user_data) {
+    auto c = get(user_data);
+    auto s = static_cast<StreamState *>(stream_user_data);
+
+    if (!s) {
+      return 0;
+    }
+
+    s->reset = true;
+    s->app_error_code = app_error_code;
+
+    c->wake(s->reader);
+
+    return 0;
+  }
+
+  static int on_extend_max_local_streams_bidi(ngtcp2_conn *conn,
+                                              uint64_t max_streams,
+                                              void *user_data) {
+    auto c = get(user_data);
+
+    c->wake(c->open_bidi_waiter_);
+
+    return 0;
+  }
+
+  static int on_extend_max_local_streams_uni(ngtcp2_conn *conn,
+                                             uint64_t max_streams,
+                                             void *user_data) {
+    auto c = get(user_data);
+
+    c->wake(c->open_uni_waiter_);
+
+    return 0;
+  }
+
+  static int on_extend_max_stream_data(ngtcp2_conn *conn, int64_t stream_id,
+                                       uint64_t max_data, void *user_data,
+                                       void *stream_user_data) {
+    auto c = get(user_data);
+    auto s = static_cast<StreamState *>(stream_user_data);
+
+    if (!s) {
+      return 0;
+    }
+
+    s->blocked = false;
+    c->schedule(*s);
+
+    return 0;
+  }
+
+  ngtcp2_conn *conn_ = nullptr;
+  std::unordered_map<int64_t, std::unique_ptr<StreamState>> streams_;
+  // sendq_ is the streams which have the data to send.
+  std::deque<StreamState *> sendq_;
+  // accept_q_ is the streams which the peer opened, and are not
+  // accepted yet.
+  std::deque<StreamState *> accept_q_;
+  // free_chunks_ is the send buffer chunks which are recycled.
+  std::vector<std::unique_ptr<StreamChunk>> free_chunks_;
+  size_t sbuf_limit_ = 256 * 1024;
+  Waiter *handshake_waiter_ = nullptr;
+  Waiter *accept_waiter_ = nullptr;
+  Waiter *open_bidi_waiter_ = nullptr;
+  Waiter *open_uni_waiter_ = nullptr;
+  // ready_head_ and ready_tail_ are the list of the waiters which are
+  // resumed by resume_ready.
+  Waiter *ready_head_ = nullptr;
+  Waiter *ready_tail_ = nullptr;
+  bool shutdown_ = false;
+};
+
+inline AwaiterBase::~AwaiterBase() { conn_.cancel(waiter_); }
+
+inline ReadAwaiter::ReadAwaiter(StreamState &s)
+    : AwaiterBase{*s.conn}, s_{s} {}
+
+inline void ReadAwaiter::await_suspend(std::coroutine_handle<> h) {
+  conn_.wait(waiter_, s_.reader, h);
+}
+
+inline ReadResult ReadAwaiter::await_resume() {
+  s_.rview.clear();
+  std::swap(s_.rview, s_.rbuf);
+
+  conn_.consume(s_, s_.rview.size());
+
+  return {
+      .data = s_.rview,
+      .fin = s_.rfin,
+      .reset = s_.reset,
+  };
+}
+
+inline WriteAwaiter::WriteAwaiter(StreamState &s,
+                                  std::span<const uint8_t> data)
+    : AwaiterBase{*s.conn}, s_{s}, data_{data} {}
+
+inline WriteAwaiter::~WriteAwaiter() {
+  if (s_.wdata == &data_) {
+    s_.wdata = nullptr;
+  }
+}
+
+inline bool WriteAwaiter::await_ready() {
+  if (s_.shut_wr || s_.fin) {
+    return true;
+  }
+
+  conn_.buffer(s_, data_);
+
+  return data_.empty();
+}
+
+inline void WriteAwaiter::await_suspend(std::coroutine_handle<> h) {
+  s_.wdata = &data_;
+  conn_.wait(waiter_, s_.writer, h);
+}
+
+inline int WriteAwaiter::await_resume() {
+  s_.wdata = nullptr;
+
+  return data_.empty() ? 0 : NGTCP2_ERR_STREAM_SHUT_WR;
+}
+
+inline void Stream::finish() {
+  if (s_->fin) {
+    return;
+  }
+
+  s_->fin = true;
+  s_->conn->schedule(*s_);
+}
+
+inline void Stream::reset(uint64_t app_error_code) {
+  auto &conn = *s_->conn;
+
+  if (!s_->closed && !conn.shutdown_) {
+    ngtcp2_conn_shutdown_stream(conn.conn_, s_->stream_id, app_error_code);
+  }
+
+  s_->fin = s_->shut_wr = true;
+
+  if (!s_->rfin) {
+    s_->reset = true;
+  }
+
+  conn.unqueue(*s_);
+  conn.wake(s_->reader);
+  conn.wake(s_->writer);
+}
+
+inline void Stream::detach() {
+  if (s_) {
+    s_->conn->detach(*s_);
+    s_ = nullptr;
+  }
+}
+
+inline bool HandshakeAwaiter::await_ready() const noexcept {
+  return conn_.shutdown_ || ngtcp2_conn_get_handshake_completed(conn_.conn_);
+}
+
+inline void HandshakeAwaiter::await_suspend(std::coroutine_handle<> h) {
+  conn_.wait(waiter_, conn_.handshake_waiter_, h);
+}
+
+inline bool HandshakeAwaiter::await_resume() const noexcept {
+  return !conn_.shutdown_;
+}
+
+inline bool OpenAwaiter::await_ready() {
+  if (conn_.shutdown_) {
+    return true;
+  }
+
+  int64_t stream_id;
+
+  auto rv = bidi_ ? ngtcp2_conn_open_bidi_stream(conn_.conn_, &stream_id,
+                                                 nullptr)
+                  : ngtcp2_conn_open_uni_stream(conn_.conn_, &stream_id,
+                                                nullptr);
+  if (rv != 0) {
+    return false;
+  }
+
+  s_ = conn_.add_stream(stream_id);
+
+  return true;
+}
+
+inline void OpenAwaiter::await_suspend(std::coroutine_handle<> h) {
+  conn_.wait(waiter_, bidi_ ? conn_.open_bidi_waiter_ : conn_.open_uni_waiter_,
+             h);
+}
+
+inline Stream OpenAwaiter::await_resume() {
+  if (!s_ && !await_ready()) {
+    // The peer has not allowed enough streams yet.
+    return Stream{};
+  }
+
+  return Stream{s_};
+}
+
+inline bool AcceptAwaiter::await_ready() const noexcept {
+  return conn_.shutdown_ || !conn_.accept_q_.empty();
+}
+
+inline void AcceptAwaiter::await_suspend(std::coroutine_handle<> h) {
+  conn_.wait(waiter_, conn_.accept_waiter_, h);
+}
+
+inline Stream AcceptAwaiter::await_resume() {
+  if (conn_.accept_q_.empty()) {
+    return Stream{};
+  }
+
+  auto s = conn_.accept_q_.front();
+
+  conn_.accept_q_.pop_front();
+
+  return Stream{s};
+}
+
+inline ngtcp2_ssize Connection::write_pkt(ngtcp2_path *path,
+                                          ngtcp2_pkt_info *pi, uint8_t *dest,
+                                          size_t destlen, ngtcp2_tstamp ts) {
+  std::array<ngtcp2_vec, 16> vec;
+
+  for (;;) {
+    StreamState *s = nullptr;
+    size_t vcnt = 0;
+    uint32_t flags = NGTCP2_WRITE_STREAM_FLAG_MORE;
+
+    if (!sendq_.empty()) {
+      s = sendq_.front();
+
+      // The connection level flow control does not block FIN.
+      if (s->sent < s->end && !ngtcp2_conn_get_max_data_left(conn_)) {
+        s = nullptr;
+      }
+    }
+
+    if (s) {
+      auto [n, all] = fill_vec(vec, *s);
+
+      vcnt = n;
+
+      if (all && s->fin) {
+        flags |= NGTCP2_WRITE_STREAM_FLAG_FIN;
+      }
+    }
+
+    ngtcp2_ssize ndatalen;
+
+    auto nwrite = ngtcp2_conn_writev_stream(conn_, path, pi, dest, destlen,
+                                            &ndatalen, flags,
+                                            s ? s->stream_id : -1, vec.data(),
+                                            vcnt, ts);
+    if (nwrite < 0) {
+      switch (nwrite) {
+      case NGTCP2_ERR_STREAM_DATA_BLOCKED:
+        // extend_max_stream_data schedules the stream again.
+        s->blocked = true;
+        unqueue(*s);
+        continue;
+      case NGTCP2_ERR_STREAM_SHUT_WR:
+        s->shut_wr = true;
+        unqueue(*s);
+        wake(s->writer);
+        continue;
+      case NGTCP2_ERR_WRITE_MORE:
+        on_sent(*s, ndatalen, flags);
+        continue;
+      }
+
+      return nwrite;
+    }
+
+    if (s && ndatalen >= 0) {
+      on_sent(*s, ndatalen, flags);
+    }
+
+    return nwrite;
+  }
+}
+
+inline void Connection::shutdown() {
+  shutdown_ = true;
+
+  for (auto s : sendq_) {
+    s->queued = false;
+  }
+
+  sendq_.clear();
+
+  for (auto &[_, s] : streams_) {
+    s->shut_wr = true;
+
+    if (!s->rfin) {
+      s->reset = true;
+    }
+
+    wake(s->reader);
+    wake(s->writer);
+  }
+
+  wake(handshake_waiter_);
+  wake(accept_waiter_);
+  wake(open_bidi_waiter_);
+  wake(open_uni_waiter_);
+}
+
+} // namespace coro
+
+} // namespace ngtcp2
+
+#endif // CORO_H
@@ -0,0 +1,328 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "coro_test.h"
+
+#include <algorithm>
+#include <string_view>
+
+#include <netinet/in.h>
+
+#include <CUnit/CUnit.h>
+
+#include "coro.h"
+
+namespace ngtcp2 {
+
+namespace {
+int recv_client_initial(ngtcp2_conn *conn, const ngtcp2_cid *dcid,
+                        void *user_data) {
+  return 0;
+}
+} // namespace
+
+namespace {
+int recv_crypto_data(ngtcp2_conn *conn, ngtcp2_crypto_level crypto_level,
+                     uint64_t offset, const uint8_t *data, size_t datalen,
+                     void *user_data) {
+  return 0;
+}
+} // namespace
+
+namespace {
+int encrypt(uint8_t *dest, const ngtcp2_crypto_aead *aead,
+            const ngtcp2_crypto_aead_ctx *aead_ctx, const uint8_t *plaintext,
+            size_t plaintextlen, const uint8_t *nonce, size_t noncelen,
+            const uint8_t *aad, size_t aadlen) {
+  return 0;
+}
+} // namespace
+
+namespace {
+int hp_mask(uint8_t *dest, const ngtcp2_crypto_cipher *hp,
+            const ngtcp2_crypto_cipher_ctx *hp_ctx, const uint8_t *sample) {
+  return 0;
+}
+} // namespace
+
+namespace {
+void rand(uint8_t *dest, size_t destlen, const ngtcp2_rand_ctx *rand_ctx) {
+  std::fill_n(dest, destlen, 0);
+}
+} // namespace
+
+namespace {
+int get_new_connection_id(ngtcp2_conn *conn, ngtcp2_cid *cid, uint8_t *token,
+                          size_t cidlen, void *user_data) {
+  return 0;
+}
+} // namespace
+
+namespace {
+int update_key(ngtcp2_conn *conn, uint8_t *rx_secret, uint8_t *tx_secret,
+               ngtcp2_crypto_aead_ctx *rx_aead_ctx, uint8_t *rx_iv,
+               ngtcp2_crypto_aead_ctx *tx_aead_ctx, uint8_t *tx_iv,
+               const uint8_t *current_rx_secret,
+               const uint8_t *current_tx_secret, size_t secretlen,
+               void *user_data) {
+  return 0;
+}
+} // namespace
+
+namespace {
+void delete_crypto_aead_ctx(ngtcp2_conn *conn, ngtcp2_crypto_aead_ctx *aead_ctx,
+                            void *user_data) {}
+} // namespace
+
+namespace {
+void delete_crypto_cipher_ctx(ngtcp2_conn *conn,
+                              ngtcp2_crypto_cipher_ctx *cipher_ctx,
+                              void *user_data) {}
+} // namespace
+
+namespace {
+int get_path_challenge_data(ngtcp2_conn *conn, uint8_t *data,
+                            void *user_data) {
+  return 0;
+}
+} // namespace
+
+namespace {
+// setup_conn creates a server connection which |c| owns.  It returns
+// the callbacks which drive |c|.
+ngtcp2_callbacks setup_conn(coro::Connection &c) {
+  ngtcp2_callbacks callbacks{};
+
+  callbacks.recv_client_initial = recv_client_initial;
+  callbacks.recv_crypto_data = recv_crypto_data;
+  callbacks.encrypt = encrypt;
+  callbacks.decrypt = encrypt;
+  callbacks.hp_mask = hp_mask;
+  callbacks.rand = rand;
+  callbacks.get_new_connection_id = get_new_connection_id;
+  callbacks.update_key = update_key;
+  callbacks.delete_crypto_aead_ctx = delete_crypto_aead_ctx;
+  callbacks.delete_crypto_cipher_ctx = delete_crypto_cipher_ctx;
+  callbacks.get_path_challenge_data = get_path_challenge_data;
+
+  coro::Connection::set_callbacks(callbacks);
+
+  ngtcp2_settings settings;
+  ngtcp2_settings_default(&settings);
+
+  ngtcp2_transport_params params;
+  ngtcp2_transport_params_default(&params);
+
+  ngtcp2_cid dcid, scid;
+  dcid.datalen = scid.datalen = 8;
+  std::fill_n(dcid.data, dcid.datalen, 0xe1);
+  std::fill_n(scid.data, scid.datalen, 0xf1);
+
+  params.original_dcid = dcid;
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+
+  ngtcp2_path path{};
+  path.local.addr = reinterpret_cast<sockaddr *>(&addr);
+  path.local.addrlen = sizeof(addr);
+  path.remote = path.local;
+
+  ngtcp2_conn *conn;
+
+  CU_ASSERT(0 == ngtcp2_conn_server_new(&conn, &dcid, &scid, &path,
+                                        NGTCP2_PROTO_VER_V1, &callbacks,
+                                        &settings, &params, nullptr, &c));
+
+  c.attach(conn);
+
+  return callbacks;
+}
+} // namespace
+
+namespace {
+struct ReadLog {
+  coro::Stream stream;
+  std::string data;
+  bool fin;
+  bool reset;
+};
+} // namespace
+
+namespace {
+coro::Task accept_and_read(coro::Connection &c, ReadLog &log) {
+  log.stream = co_await c.accept();
+
+  if (!log.stream) {
+    co_return;
+  }
+
+  for (;;) {
+    auto r = co_await log.stream.read();
+
+    log.data.append(r.data.begin(), r.data.end());
+    log.fin = r.fin;
+    log.reset = r.reset;
+
+    if (r.fin || r.reset) {
+      co_return;
+    }
+  }
+}
+} // namespace
+
+void test_coro_read() {
+  coro::Connection c;
+  auto callbacks = setup_conn(c);
+  ReadLog log{};
+  constexpr std::string_view data = "hello world";
+
+  auto task = accept_and_read(c, log);
+
+  CU_ASSERT(!task.done());
+
+  CU_ASSERT(0 == callbacks.stream_open(c.conn(), 0, &c));
+
+  // The coroutine is resumed outside the callback.
+  CU_ASSERT(!log.stream);
+
+  c.resume_ready();
+
+  CU_ASSERT(log.stream);
+  CU_ASSERT(0 == log.stream.id());
+
+  auto s = c.find_stream(0);
+
+  CU_ASSERT(nullptr != s);
+  CU_ASSERT(0 == callbacks.recv_stream_data(
+                     c.conn(), NGTCP2_STREAM_DATA_FLAG_NONE, 0, 0,
+                     reinterpret_cast<const uint8_t *>(data.data()), 5, &c,
+                     s));
+  CU_ASSERT(0 == callbacks.recv_stream_data(
+                     c.conn(), NGTCP2_STREAM_DATA_FLAG_FIN, 0, 5,
+                     reinterpret_cast<const uint8_t *>(data.data()) + 5,
+                     data.size() - 5, &c, s));
+
+  CU_ASSERT(log.data.empty());
+
+  c.resume_ready();
+
+  CU_ASSERT(task.done());
+  CU_ASSERT(data == log.data);
+  CU_ASSERT(log.fin);
+  CU_ASSERT(!log.reset);
+}
+
+namespace {
+coro::Task accept_and_write(coro::Connection &c, coro::Stream &stream,
+                            std::span<const uint8_t> data, int &rv) {
+  stream = co_await c.accept();
+
+  if (!stream) {
+    co_return;
+  }
+
+  rv = co_await stream.write(data);
+
+  stream.finish();
+}
+} // namespace
+
+void test_coro_write() {
+  coro::Connection c;
+  auto callbacks = setup_conn(c);
+  coro::Stream stream;
+  std::vector<uint8_t> data(300 * 1024);
+  int rv = -1;
+
+  c.set_send_buffer_size(256 * 1024);
+
+  CU_ASSERT(0 == callbacks.stream_open(c.conn(), 0, &c));
+
+  auto task = accept_and_write(c, stream, data, rv);
+
+  auto s = c.find_stream(0);
+
+  // The send buffer is full.
+  CU_ASSERT(!task.done());
+  CU_ASSERT(256 * 1024 == s->end);
+  CU_ASSERT(!s->fin);
+
+  // Acknowledging the data makes room for the rest.
+  CU_ASSERT(0 == callbacks.acked_stream_data_offset(c.conn(), 0, 0,
+                                                    32 * 1024, &c, s));
+
+  CU_ASSERT(!task.done());
+  CU_ASSERT(288 * 1024 == s->end);
+  CU_ASSERT(16 == s->chunks.size());
+
+  CU_ASSERT(0 == callbacks.acked_stream_data_offset(c.conn(), 0, 32 * 1024,
+                                                    32 * 1024, &c, s));
+
+  CU_ASSERT(300 * 1024 == s->end);
+
+  c.resume_ready();
+
+  CU_ASSERT(task.done());
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(s->fin);
+  CU_ASSERT(s->queued);
+}
+
+void test_coro_cancel() {
+  coro::Connection c;
+  auto callbacks = setup_conn(c);
+  ReadLog log{};
+
+  {
+    auto task = accept_and_read(c, log);
+
+    CU_ASSERT(0 == callbacks.stream_open(c.conn(), 0, &c));
+
+    // Destroying the task removes it from the ready queue.
+  }
+
+  c.resume_ready();
+
+  CU_ASSERT(!log.stream);
+
+  auto task = accept_and_read(c, log);
+
+  CU_ASSERT(log.stream);
+  CU_ASSERT(!task.done());
+
+  c.shutdown();
+  c.resume_ready();
+
+  CU_ASSERT(task.done());
+  CU_ASSERT(log.reset);
+  CU_ASSERT(!log.fin);
+
+  auto task2 = accept_and_read(c, log);
+
+  // accept fails after the shutdown.
+  CU_ASSERT(task2.done());
+}
+
+} // namespace ngtcp2
@@ -37,7 +37,7 @@ namespace ngtcp2 {
 namespace debug {
 
 namespace {
-auto randgen = util::make_mt19937();
+thread_local auto randgen = util::make_mt19937();
 } // namespace
 
 namespace {
@@ -187,6 +187,10 @@ void log_printf(void *user_data, const char *fmt, ...) {
   fprintf(stderr, "\n");
 }
 
+void log_record(void *user_data, const ngtcp2_log_record *rec) {
+  ngtcp2_log_record_print(rec, log_printf, user_data);
+}
+
 void path_validation(const ngtcp2_path *path,
                      ngtcp2_path_validation_result res) {
   auto local_addr = util::straddr(
@@ -91,6 +91,11 @@ void print_hp_mask(const uint8_t *mask, size_t masklen, const uint8_t *sample,
 
 void log_printf(void *user_data, const char *fmt, ...);
 
+// log_record renders |rec| to stderr.  It is used as
+// ngtcp2_settings.log_record, so that the library defers the
+// formatting to here.
+void log_record(void *user_data, const ngtcp2_log_record *rec);
+
 void path_validation(const ngtcp2_path *path,
                      ngtcp2_path_validation_result res);
 
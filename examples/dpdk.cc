@@ -0,0 +1,501 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "dpdk.h"
+
+#ifdef HAVE_LIBDPDK
+#  include <rte_eal.h>
+#  include <rte_ethdev.h>
+#  include <rte_lcore.h>
+#  include <rte_mbuf.h>
+#  include <rte_mempool.h>
+#  include <rte_ring.h>
+#endif // HAVE_LIBDPDK
+
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <string>
+
+namespace ngtcp2 {
+
+namespace dpdk {
+
+namespace {
+// HEADER_FORM_BIT is the Header Form bit in the first byte of QUIC
+// packet.
+constexpr uint8_t HEADER_FORM_BIT = 0x80;
+// LONG_DCIDLEN_OFFSET is the offset to Destination Connection ID
+// Length field in long header packet.
+constexpr size_t LONG_DCIDLEN_OFFSET = 5;
+} // namespace
+
+int dcid_worker(const uint8_t *pkt, size_t pktlen, size_t nworkers) {
+  assert(nworkers);
+
+  if (pktlen == 0) {
+    return -1;
+  }
+
+  if (pkt[0] & HEADER_FORM_BIT) {
+    if (pktlen < LONG_DCIDLEN_OFFSET + 2 || pkt[LONG_DCIDLEN_OFFSET] == 0) {
+      return -1;
+    }
+
+    return static_cast<int>(pkt[LONG_DCIDLEN_OFFSET + 1] % nworkers);
+  }
+
+  if (pktlen < 2) {
+    return -1;
+  }
+
+  return static_cast<int>(pkt[1] % nworkers);
+}
+
+} // namespace dpdk
+
+#ifdef HAVE_LIBDPDK
+namespace {
+// dpdk_nrxdesc and dpdk_ntxdesc are the number of descriptors of
+// each receive and transmit queue.
+constexpr uint16_t dpdk_nrxdesc = 1024;
+constexpr uint16_t dpdk_ntxdesc = 1024;
+// dpdk_ring_size is the number of entries of the ring which hands
+// datagrams over to a worker.
+constexpr unsigned int dpdk_ring_size = 1024;
+// dpdk_burst is the maximum number of mbufs received or transmitted
+// at once.
+constexpr size_t dpdk_burst = 32;
+constexpr unsigned int dpdk_mempool_cache_size = 256;
+} // namespace
+
+DpdkPort::DpdkPort()
+    : mp_(nullptr),
+      mac_{},
+      port_id_(0),
+      nqueues_(0),
+      udp_port_(0),
+      eal_initialized_(false),
+      started_(false) {}
+
+DpdkPort::~DpdkPort() {
+  if (started_) {
+    rte_eth_dev_stop(port_id_);
+    rte_eth_dev_close(port_id_);
+  }
+
+  for (auto r : rings_) {
+    void *m;
+
+    while (rte_ring_dequeue(r, &m) == 0) {
+      rte_pktmbuf_free(static_cast<rte_mbuf *>(m));
+    }
+
+    rte_ring_free(r);
+  }
+
+  if (mp_) {
+    rte_mempool_free(mp_);
+  }
+
+  if (eal_initialized_) {
+    rte_eal_cleanup();
+  }
+}
+
+int DpdkPort::init(std::string_view eal_args, uint16_t port_id,
+                   uint16_t nqueues, uint16_t udp_port) {
+  assert(nqueues);
+
+  std::vector<std::string> args{"server"};
+
+  for (auto p = std::begin(eal_args); p != std::end(eal_args);) {
+    p = std::find_if_not(p, std::end(eal_args), [](auto c) {
+      return c == ' ' || c == '\t';
+    });
+    auto q = std::find_if(p, std::end(eal_args),
+                          [](auto c) { return c == ' ' || c == '\t'; });
+    if (p != q) {
+      args.emplace_back(p, q);
+    }
+    p = q;
+  }
+
+  std::vector<char *> argv;
+  for (auto &a : args) {
+    argv.push_back(a.data());
+  }
+  argv.push_back(nullptr);
+
+  if (rte_eal_init(static_cast<int>(args.size()), argv.data()) < 0) {
+    std::cerr << "rte_eal_init: " << rte_strerror(rte_errno) << std::endl;
+    return -1;
+  }
+
+  eal_initialized_ = true;
+
+  if (!rte_eth_dev_is_valid_port(port_id)) {
+    std::cerr << "dpdk: port " << port_id << " is not available" << std::endl;
+    return -1;
+  }
+
+  port_id_ = port_id;
+  nqueues_ = nqueues;
+  udp_port_ = udp_port;
+
+  unsigned int lcore_id;
+  RTE_LCORE_FOREACH(lcore_id) { lcores_.push_back(lcore_id); }
+
+  if (lcores_.size() < nqueues) {
+    std::cerr << "dpdk: " << lcores_.size() << " lcores are given for "
+              << nqueues << " workers; workers are not pinned to lcores"
+              << std::endl;
+  }
+
+  rte_eth_dev_info dev_info;
+  if (auto rv = rte_eth_dev_info_get(port_id_, &dev_info); rv != 0) {
+    std::cerr << "rte_eth_dev_info_get: " << rte_strerror(-rv) << std::endl;
+    return -1;
+  }
+
+  if (nqueues_ > dev_info.max_rx_queues || nqueues_ > dev_info.max_tx_queues) {
+    std::cerr << "dpdk: port " << port_id_ << " supports up to "
+              << std::min(dev_info.max_rx_queues, dev_info.max_tx_queues)
+              << " queues" << std::endl;
+    return -1;
+  }
+
+  auto socket_id = rte_eth_dev_socket_id(port_id_);
+  if (socket_id < 0) {
+    socket_id = static_cast<int>(rte_socket_id());
+  }
+
+  // Each queue needs mbufs for its receive and transmit descriptors,
+  // its ring, and a burst in flight.
+  auto nmbufs = static_cast<unsigned int>(nqueues_) *
+                (dpdk_nrxdesc + dpdk_ntxdesc + dpdk_ring_size +
+                 static_cast<unsigned int>(dpdk_burst) +
+                 dpdk_mempool_cache_size);
+
+  mp_ = rte_pktmbuf_pool_create("ngtcp2_mbuf_pool", nmbufs,
+                                dpdk_mempool_cache_size, 0,
+                                RTE_MBUF_DEFAULT_BUF_SIZE, socket_id);
+  if (!mp_) {
+    std::cerr << "rte_pktmbuf_pool_create: " << rte_strerror(rte_errno)
+              << std::endl;
+    return -1;
+  }
+
+  for (uint16_t i = 0; i < nqueues_; ++i) {
+    auto name = "ngtcp2_ring_" + std::to_string(i);
+    auto r = rte_ring_create(name.c_str(), dpdk_ring_size, socket_id,
+                             RING_F_SC_DEQ);
+    if (!r) {
+      std::cerr << "rte_ring_create: " << rte_strerror(rte_errno)
+                << std::endl;
+      return -1;
+    }
+
+    rings_.push_back(r);
+  }
+
+  rte_eth_conf conf{};
+
+  if (nqueues_ > 1) {
+    conf.rxmode.mq_mode = RTE_ETH_MQ_RX_RSS;
+    conf.rx_adv_conf.rss_conf.rss_hf =
+        (RTE_ETH_RSS_NONFRAG_IPV4_UDP | RTE_ETH_RSS_NONFRAG_IPV6_UDP) &
+        dev_info.flow_type_rss_offloads;
+  }
+
+  if (auto rv = rte_eth_dev_configure(port_id_, nqueues_, nqueues_, &conf);
+      rv != 0) {
+    std::cerr << "rte_eth_dev_configure: " << rte_strerror(-rv) << std::endl;
+    return -1;
+  }
+
+  auto nrxdesc = dpdk_nrxdesc;
+  auto ntxdesc = dpdk_ntxdesc;
+
+  if (auto rv = rte_eth_dev_adjust_nb_rx_tx_desc(port_id_, &nrxdesc, &ntxdesc);
+      rv != 0) {
+    std::cerr << "rte_eth_dev_adjust_nb_rx_tx_desc: " << rte_strerror(-rv)
+              << std::endl;
+    return -1;
+  }
+
+  for (uint16_t i = 0; i < nqueues_; ++i) {
+    if (auto rv =
+            rte_eth_rx_queue_setup(port_id_, i, nrxdesc,
+                                   static_cast<unsigned int>(socket_id),
+                                   nullptr, mp_);
+        rv != 0) {
+      std::cerr << "rte_eth_rx_queue_setup: " << rte_strerror(-rv)
+                << std::endl;
+      return -1;
+    }
+
+    if (auto rv = rte_eth_tx_queue_setup(port_id_, i, ntxdesc,
+                                         static_cast<unsigned int>(socket_id),
+                                         nullptr);
+        rv != 0) {
+      std::cerr << "rte_eth_tx_queue_setup: " << rte_strerror(-rv)
+                << std::endl;
+      return -1;
+    }
+  }
+
+  if (auto rv = rte_eth_dev_start(port_id_); rv != 0) {
+    std::cerr << "rte_eth_dev_start: " << rte_strerror(-rv) << std::endl;
+    return -1;
+  }
+
+  started_ = true;
+
+  rte_ether_addr addr;
+  if (auto rv = rte_eth_macaddr_get(port_id_, &addr); rv != 0) {
+    std::cerr << "rte_eth_macaddr_get: " << rte_strerror(-rv) << std::endl;
+    return -1;
+  }
+
+  std::copy_n(addr.addr_bytes, mac_.size(), std::begin(mac_));
+
+  return 0;
+}
+
+uint16_t DpdkPort::port_id() const { return port_id_; }
+
+uint16_t DpdkPort::nqueues() const { return nqueues_; }
+
+uint16_t DpdkPort::udp_port() const { return udp_port_; }
+
+rte_mempool *DpdkPort::mempool() const { return mp_; }
+
+rte_ring *DpdkPort::ring(uint16_t queue_id) const { return rings_[queue_id]; }
+
+int DpdkPort::lcore(uint16_t queue_id) const {
+  if (queue_id >= lcores_.size()) {
+    return -1;
+  }
+
+  return static_cast<int>(lcores_[queue_id]);
+}
+
+const xdp::MacAddr &DpdkPort::mac() const { return mac_; }
+
+namespace {
+uint16_t get_port(const Address &addr) {
+  if (addr.su.sa.sa_family == AF_INET) {
+    return ntohs(addr.su.in.sin_port);
+  }
+
+  return ntohs(addr.su.in6.sin6_port);
+}
+} // namespace
+
+DpdkQueue::DpdkQueue(const DpdkPort &port, uint16_t queue_id)
+    : port_(port), queue_id_(queue_id), registered_(false) {}
+
+void DpdkQueue::register_lcore() {
+  registered_ = true;
+
+  // The worker thread is created by std::thread, and inherits the
+  // affinity of the main lcore.  Move it to its own lcore, and make
+  // it an EAL thread, so that the per-lcore mempool cache is used.
+  if (rte_lcore_id() != LCORE_ID_ANY) {
+    return;
+  }
+
+  if (auto lcore = port_.lcore(queue_id_); lcore != -1) {
+    auto cpuset = rte_lcore_cpuset(static_cast<unsigned int>(lcore));
+    rte_thread_set_affinity(&cpuset);
+  }
+
+  if (rte_thread_register() != 0) {
+    std::cerr << "rte_thread_register: " << rte_strerror(rte_errno)
+              << std::endl;
+  }
+}
+
+size_t DpdkQueue::read(
+    const std::function<void(const xdp::FrameInfo &, uint8_t *)> &f,
+    size_t max) {
+  if (!registered_) {
+    register_lcore();
+  }
+
+  std::array<rte_mbuf *, dpdk_burst> pkts;
+  auto nqueues = port_.nqueues();
+  size_t nread = 0;
+
+  auto deliver = [this, &f](rte_mbuf *m, xdp::FrameInfo &fi) {
+    neighbors_.learn(fi);
+
+    f(fi, rte_pktmbuf_mtod(m, uint8_t *) + fi.payload_offset);
+
+    rte_pktmbuf_free(m);
+  };
+
+  // The datagrams handed over by the other workers have been
+  // validated by them.
+  auto n = rte_ring_dequeue_burst(port_.ring(queue_id_),
+                                  reinterpret_cast<void **>(pkts.data()),
+                                  static_cast<unsigned int>(pkts.size()),
+                                  nullptr);
+  for (size_t i = 0; i < n; ++i) {
+    auto m = pkts[i];
+    xdp::FrameInfo fi;
+
+    [[maybe_unused]] auto rv = xdp::parse_udp_frame(
+        fi, rte_pktmbuf_mtod(m, const uint8_t *), rte_pktmbuf_data_len(m));
+
+    assert(0 == rv);
+
+    deliver(m, fi);
+  }
+
+  nread += n;
+
+  for (; nread < max;) {
+    auto nrx = rte_eth_rx_burst(
+        port_.port_id(), queue_id_, pkts.data(),
+        static_cast<uint16_t>(std::min(pkts.size(), max - nread)));
+    if (nrx == 0) {
+      break;
+    }
+
+    nread += nrx;
+
+    for (size_t i = 0; i < nrx; ++i) {
+      auto m = pkts[i];
+      xdp::FrameInfo fi;
+
+      // There is no kernel network stack behind the port.  A frame
+      // which is not a QUIC datagram to the server is dropped.
+      if (m->nb_segs != 1 ||
+          xdp::parse_udp_frame(fi, rte_pktmbuf_mtod(m, const uint8_t *),
+                               rte_pktmbuf_data_len(m)) != 0 ||
+          get_port(fi.local_addr) != port_.udp_port()) {
+        rte_pktmbuf_free(m);
+        continue;
+      }
+
+      if (nqueues > 1) {
+        auto worker = dpdk::dcid_worker(rte_pktmbuf_mtod(m, const uint8_t *) +
+                                            fi.payload_offset,
+                                        fi.payloadlen, nqueues);
+        if (worker != -1 && static_cast<uint16_t>(worker) != queue_id_) {
+          if (rte_ring_enqueue(port_.ring(static_cast<uint16_t>(worker)),
+                               m) != 0) {
+            rte_pktmbuf_free(m);
+          }
+
+          continue;
+        }
+      }
+
+      deliver(m, fi);
+    }
+
+    if (nrx < pkts.size()) {
+      break;
+    }
+  }
+
+  return nread;
+}
+
+std::pair<size_t, int> DpdkQueue::send(const ngtcp2_addr &local_addr,
+                                       const ngtcp2_addr &remote_addr,
+                                       unsigned int ecn, const uint8_t *data,
+                                       size_t datalen, size_t gso_size) {
+  auto mac = neighbors_.find(remote_addr.addr);
+  if (!mac) {
+    return {datalen, NETWORK_ERR_OK};
+  }
+
+  auto hdrlen = xdp::udp_frame_hdrlen(local_addr.addr->sa_family);
+
+  if (hdrlen + gso_size > RTE_MBUF_DEFAULT_DATAROOM) {
+    // Too large to fit in a mbuf.
+    return {datalen, NETWORK_ERR_OK};
+  }
+
+  std::array<rte_mbuf *, dpdk_burst> pkts;
+  std::array<size_t, dpdk_burst> lens;
+  size_t nsent = 0;
+
+  for (auto p = data, end = data + datalen; p != end;) {
+    size_t n = 0;
+
+    for (; p != end && n < pkts.size(); ++n) {
+      auto len = std::min(gso_size, static_cast<size_t>(end - p));
+      auto m = rte_pktmbuf_alloc(port_.mempool());
+      if (!m) {
+        break;
+      }
+
+      auto frame = reinterpret_cast<uint8_t *>(
+          rte_pktmbuf_append(m, static_cast<uint16_t>(hdrlen + len)));
+
+      memcpy(frame + hdrlen, p, len);
+
+      xdp::write_udp_frame_header(frame, port_.mac(), *mac, local_addr.addr,
+                                  remote_addr.addr, ecn, len);
+
+      pkts[n] = m;
+      lens[n] = len;
+      p += len;
+    }
+
+    if (n == 0) {
+      break;
+    }
+
+    auto ntx = rte_eth_tx_burst(port_.port_id(), queue_id_, pkts.data(),
+                                static_cast<uint16_t>(n));
+
+    for (size_t i = 0; i < ntx; ++i) {
+      nsent += lens[i];
+    }
+
+    if (ntx < n) {
+      rte_pktmbuf_free_bulk(pkts.data() + ntx,
+                            static_cast<unsigned int>(n - ntx));
+
+      break;
+    }
+  }
+
+  if (nsent < datalen) {
+    return {nsent, NETWORK_ERR_SEND_BLOCKED};
+  }
+
+  return {nsent, NETWORK_ERR_OK};
+}
+#endif // HAVE_LIBDPDK
+
+} // namespace ngtcp2
@@ -0,0 +1,145 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef DPDK_H
+#define DPDK_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <ngtcp2/ngtcp2.h>
+
+#include "network.h"
+#include "xdp.h"
+
+#ifdef HAVE_LIBDPDK
+struct rte_mempool;
+struct rte_ring;
+#endif // HAVE_LIBDPDK
+
+namespace ngtcp2 {
+
+namespace dpdk {
+
+// dcid_worker returns the index of the worker which owns the
+// connection that QUIC packet |pkt| of length |pktlen| belongs to,
+// among |nworkers| workers.  It is derived from the first byte of
+// Destination Connection ID in the same way as bpf/reuseport_kern.c
+// does.  It returns -1 if |pkt| is too short, or has zero length
+// Destination Connection ID.
+int dcid_worker(const uint8_t *pkt, size_t pktlen, size_t nworkers);
+
+} // namespace dpdk
+
+#ifdef HAVE_LIBDPDK
+// DpdkPort is an Ethernet port driven by DPDK poll mode driver.  It
+// has a receive and transmit queue pair for each worker.  The
+// hardware distributes the incoming datagrams over the receive queues
+// by RSS on UDP 4-tuple, and then a worker hands a datagram of a
+// connection owned by another worker over to it through the ring of
+// that worker, so that all packets of a connection are processed on
+// the same lcore.
+class DpdkPort {
+public:
+  DpdkPort();
+  ~DpdkPort();
+
+  // init initializes EAL with the whitespace separated arguments
+  // |eal_args|, and starts |port_id| with |nqueues| queue pairs.  Only
+  // the UDP datagrams destined to |udp_port| are delivered.
+  int init(std::string_view eal_args, uint16_t port_id, uint16_t nqueues,
+           uint16_t udp_port);
+  uint16_t port_id() const;
+  uint16_t nqueues() const;
+  uint16_t udp_port() const;
+  rte_mempool *mempool() const;
+  // ring returns the ring which the datagrams handed over to the
+  // worker |queue_id| are enqueued to.
+  rte_ring *ring(uint16_t queue_id) const;
+  // lcore returns the lcore which the worker |queue_id| runs on, or
+  // -1 if EAL is given fewer lcores than the workers.
+  int lcore(uint16_t queue_id) const;
+  const xdp::MacAddr &mac() const;
+
+private:
+  rte_mempool *mp_;
+  std::vector<rte_ring *> rings_;
+  std::vector<unsigned int> lcores_;
+  xdp::MacAddr mac_;
+  uint16_t port_id_;
+  uint16_t nqueues_;
+  uint16_t udp_port_;
+  bool eal_initialized_;
+  bool started_;
+};
+
+// DpdkQueue is a receive and transmit queue pair of DpdkPort which a
+// worker polls.  A received datagram is passed to the connection in
+// its mbuf without copying.  Each transmitted datagram is copied into
+// a mbuf after the space for the headers.
+class DpdkQueue {
+public:
+  DpdkQueue(const DpdkPort &port, uint16_t queue_id);
+
+  // read receives the datagrams handed over by the other workers, and
+  // up to |max| frames from the receive queue, and calls |f| for each
+  // UDP datagram owned by this worker.  The payload passed to |f| is
+  // in mbuf, and is valid until |f| returns.  It returns the number
+  // of frames processed.
+  size_t read(
+      const std::function<void(const xdp::FrameInfo &, uint8_t *)> &f,
+      size_t max);
+  // send sends |data| of length |datalen| which is a batch of UDP
+  // datagrams each of which is |gso_size| bytes long except for the
+  // last one.  It returns the number of bytes sent, and
+  // NETWORK_ERR_OK, or NETWORK_ERR_SEND_BLOCKED if there is no mbuf
+  // or transmit descriptor available.  The datagram to a remote
+  // address whose MAC address is unknown is dropped.
+  std::pair<size_t, int> send(const ngtcp2_addr &local_addr,
+                              const ngtcp2_addr &remote_addr,
+                              unsigned int ecn, const uint8_t *data,
+                              size_t datalen, size_t gso_size);
+
+private:
+  // register_lcore binds the calling thread to the lcore of this
+  // queue if it is not an EAL thread yet.
+  void register_lcore();
+
+  const DpdkPort &port_;
+  xdp::NeighborTable neighbors_;
+  uint16_t queue_id_;
+  bool registered_;
+};
+#endif // HAVE_LIBDPDK
+
+} // namespace ngtcp2
+
+#endif // DPDK_H
@@ -0,0 +1,62 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "dpdk_test.h"
+
+#include <array>
+
+#include <CUnit/CUnit.h>
+
+#include "dpdk.h"
+
+namespace ngtcp2 {
+
+void test_dpdk_dcid_worker() {
+  // Short header packet: DCID starts at the second byte.
+  {
+    std::array<uint8_t, 4> pkt{0x40, 0x0b, 0xff, 0xff};
+
+    CU_ASSERT(3 == dpdk::dcid_worker(pkt.data(), pkt.size(), 4));
+    CU_ASSERT(0 == dpdk::dcid_worker(pkt.data(), pkt.size(), 1));
+    CU_ASSERT(-1 == dpdk::dcid_worker(pkt.data(), 1, 4));
+  }
+
+  // Long header packet: DCID follows DCID Length field.
+  {
+    std::array<uint8_t, 8> pkt{0xc0, 0x00, 0x00, 0x00, 0x01, 0x08, 0x0a, 0xff};
+
+    CU_ASSERT(1 == dpdk::dcid_worker(pkt.data(), pkt.size(), 3));
+    CU_ASSERT(-1 == dpdk::dcid_worker(pkt.data(), 6, 3));
+
+    // Zero length DCID
+    pkt[5] = 0;
+
+    CU_ASSERT(-1 == dpdk::dcid_worker(pkt.data(), pkt.size(), 3));
+  }
+
+  // Empty packet
+  CU_ASSERT(-1 == dpdk::dcid_worker(nullptr, 0, 4));
+}
+
+} // namespace ngtcp2
@@ -0,0 +1,176 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef DYN_PATTERN_H
+#define DYN_PATTERN_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <cassert>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <memory>
+#include <string>
+
+// DynChecksum is a Fletcher style checksum of a byte stream.  s1 is
+// the sum of the bytes, and s2 is the sum of s1 after each byte, both
+// modulo 2^64.  Unlike a plain sum, s2 detects reordered bytes.  A
+// client updates it as the response body arrives, and compares it
+// with x-ngtcp2-checksum trailer field.
+struct DynChecksum {
+  void update(const uint8_t *data, size_t len) {
+    auto a = s1;
+    auto b = s2;
+
+    for (auto end = data + len; data != end; ++data) {
+      a += *data;
+      b += a;
+    }
+
+    s1 = a;
+    s2 = b;
+  }
+
+  bool operator==(const DynChecksum &other) const = default;
+
+  uint64_t s1;
+  uint64_t s2;
+};
+
+// format_dyn_checksum returns |ck| in the format of x-ngtcp2-checksum
+// trailer field, that is s1 and s2 in hex separated by '-'.
+inline std::string format_dyn_checksum(const DynChecksum &ck) {
+  std::array<char, 2 * 16 + 1> buf;
+  auto p = buf.data();
+  auto end = p + buf.size();
+
+  p = std::to_chars(p, end, ck.s1, 16).ptr;
+  *p++ = '-';
+  p = std::to_chars(p, end, ck.s2, 16).ptr;
+
+  return {buf.data(), p};
+}
+
+// DynPattern is a pseudo random pattern which the server sends as the
+// body of a dynamic response.  The body of a response of length n
+// which starts at offset |start| in the pattern is
+//
+//   pattern[(start + i) % PERIOD] for 0 <= i < n.
+//
+// The pattern is generated once, and the body is handed to the HTTP/3
+// stack by pointing into it, so the response costs no per-byte work
+// on the server.  data() has MAX_CHUNK bytes beyond PERIOD which
+// repeat the beginning of the pattern, so that any chunk of at most
+// MAX_CHUNK bytes is contiguous.  The prefix sums of the pattern let
+// checksum compute DynChecksum of the whole body in O(n / PERIOD).
+class DynPattern {
+public:
+  static constexpr size_t PERIOD = 256 * 1024;
+  static constexpr size_t MAX_CHUNK = 16 * 1024;
+
+  DynPattern()
+      : buf_(std::make_unique<uint8_t[]>(PERIOD + MAX_CHUNK)),
+        sum_(std::make_unique<uint64_t[]>(PERIOD + 1)),
+        wsum_(std::make_unique<uint64_t[]>(PERIOD + 1)) {
+    // splitmix64 with a fixed seed makes the pattern identical on
+    // every run and every host.
+    uint64_t x = 0;
+
+    for (size_t i = 0; i < PERIOD; i += 8) {
+      x += 0x9e3779b97f4a7c15ull;
+      auto z = x;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      z ^= z >> 31;
+
+      for (size_t j = 0; j < 8; ++j) {
+        buf_[i + j] = static_cast<uint8_t>(z >> (j * 8));
+      }
+    }
+
+    for (size_t i = 0; i < MAX_CHUNK; ++i) {
+      buf_[PERIOD + i] = buf_[i];
+    }
+
+    sum_[0] = wsum_[0] = 0;
+
+    for (size_t i = 0; i < PERIOD; ++i) {
+      sum_[i + 1] = sum_[i] + buf_[i];
+      wsum_[i + 1] = wsum_[i] + i * buf_[i];
+    }
+  }
+
+  DynPattern(const DynPattern &) = delete;
+  DynPattern &operator=(const DynPattern &) = delete;
+
+  const uint8_t *data() const { return buf_.get(); }
+
+  // start_offset returns the offset in the pattern where the body of
+  // the response on |stream_id| starts.  Different streams get
+  // different content.
+  static size_t start_offset(int64_t stream_id) {
+    return static_cast<size_t>((static_cast<uint64_t>(stream_id) *
+                                0x9e3779b97f4a7c15ull) >>
+                               32) %
+           PERIOD;
+  }
+
+  // checksum returns DynChecksum of the body of length |len| which
+  // starts at offset |start| in the pattern.
+  DynChecksum checksum(size_t start, uint64_t len) const {
+    assert(start < PERIOD);
+
+    DynChecksum ck{};
+
+    while (len) {
+      auto n = static_cast<size_t>(
+          std::min(len, static_cast<uint64_t>(PERIOD - start)));
+      auto end = start + n;
+      // Each byte p[j] is added to s2 (end - j) times.
+      auto s1 = sum_[end] - sum_[start];
+      auto s2 = end * s1 - (wsum_[end] - wsum_[start]);
+
+      ck.s2 += n * ck.s1 + s2;
+      ck.s1 += s1;
+
+      len -= n;
+      start = 0;
+    }
+
+    return ck;
+  }
+
+private:
+  std::unique_ptr<uint8_t[]> buf_;
+  // sum_[k] is the sum of the first k bytes of the pattern.
+  std::unique_ptr<uint64_t[]> sum_;
+  // wsum_[k] is the sum of j * pattern[j] for j < k.
+  std::unique_ptr<uint64_t[]> wsum_;
+};
+
+#endif // DYN_PATTERN_H
@@ -0,0 +1,111 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "dyn_pattern_test.h"
+
+#include <cstring>
+#include <array>
+
+#include <CUnit/CUnit.h>
+
+#include "dyn_pattern.h"
+
+namespace ngtcp2 {
+
+namespace {
+// body_checksum computes DynChecksum of the body by feeding it in
+// chunks like a client does.
+DynChecksum body_checksum(const DynPattern &pat, size_t start, uint64_t len) {
+  DynChecksum ck{};
+
+  while (len) {
+    auto n = static_cast<size_t>(
+        std::min(len, static_cast<uint64_t>(DynPattern::MAX_CHUNK)));
+
+    ck.update(pat.data() + start, n);
+
+    start = (start + n) % DynPattern::PERIOD;
+    len -= n;
+  }
+
+  return ck;
+}
+} // namespace
+
+void test_dyn_pattern_checksum() {
+  DynPattern pat;
+
+  CU_ASSERT(0 == memcmp(pat.data(), pat.data() + DynPattern::PERIOD,
+                        DynPattern::MAX_CHUNK));
+
+  std::array<std::pair<size_t, uint64_t>, 7> cases{{
+      {0, 0},
+      {0, 1},
+      {100, 1000},
+      {DynPattern::PERIOD - 10, 20},
+      {0, DynPattern::PERIOD},
+      {12345, 3 * DynPattern::PERIOD + 777},
+      {DynPattern::PERIOD - 1, 2 * DynPattern::PERIOD},
+  }};
+
+  for (auto [start, len] : cases) {
+    CU_ASSERT(body_checksum(pat, start, len) == pat.checksum(start, len));
+  }
+
+  // A single corrupted byte changes the checksum.
+  std::array<uint8_t, 64> body;
+  memcpy(body.data(), pat.data(), body.size());
+
+  DynChecksum ck{};
+  ck.update(body.data(), body.size());
+
+  CU_ASSERT(ck == pat.checksum(0, body.size()));
+
+  body[10] ^= 1;
+
+  ck = {};
+  ck.update(body.data(), body.size());
+
+  CU_ASSERT(!(ck == pat.checksum(0, body.size())));
+
+  // Swapped bytes change the checksum, too.
+  memcpy(body.data(), pat.data(), body.size());
+  std::swap(body[3], body[40]);
+
+  ck = {};
+  ck.update(body.data(), body.size());
+
+  CU_ASSERT(body[3] == body[40] || !(ck == pat.checksum(0, body.size())));
+
+  CU_ASSERT("0-0" == format_dyn_checksum({}));
+  CU_ASSERT("ff-ffffffffffffffff" ==
+            format_dyn_checksum({.s1 = 0xff, .s2 = UINT64_MAX}));
+
+  // Streams start at different offsets.
+  CU_ASSERT(DynPattern::start_offset(0) != DynPattern::start_offset(4));
+  CU_ASSERT(DynPattern::start_offset(4) != DynPattern::start_offset(8));
+  CU_ASSERT(DynPattern::start_offset(4) < DynPattern::PERIOD);
+}
+
+} // namespace ngtcp2
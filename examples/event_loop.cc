@@ -0,0 +1,116 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "event_loop.h"
+
+#include <array>
+#include <utility>
+
+namespace ngtcp2 {
+
+namespace {
+constexpr std::array<std::pair<std::string_view, unsigned int>, 8> backends{{
+    {"select", EVBACKEND_SELECT},
+    {"poll", EVBACKEND_POLL},
+    {"epoll", EVBACKEND_EPOLL},
+    {"kqueue", EVBACKEND_KQUEUE},
+    {"devpoll", EVBACKEND_DEVPOLL},
+    {"port", EVBACKEND_PORT},
+#if EV_VERSION_MAJOR > 4 || (EV_VERSION_MAJOR == 4 && EV_VERSION_MINOR >= 31)
+    {"linuxaio", EVBACKEND_LINUXAIO},
+    {"io_uring", EVBACKEND_IOURING},
+#endif // libev 4.31 or later
+}};
+} // namespace
+
+std::optional<unsigned int> parse_event_loop_backend(std::string_view s) {
+  if (s == "auto") {
+    return 0;
+  }
+
+  for (auto &[name, backend] : backends) {
+    if (backend && name == s) {
+      return backend;
+    }
+  }
+
+  return {};
+}
+
+std::string_view event_loop_backend_name(unsigned int backend) {
+  for (auto &[name, b] : backends) {
+    if (b && b == backend) {
+      return name;
+    }
+  }
+
+  return "unknown";
+}
+
+namespace {
+unsigned int event_loop_flags(const EventLoopConfig &config) {
+  if (config.backend == 0) {
+    return EVFLAG_AUTO;
+  }
+
+  // Ignore LIBEV_FLAGS so that the backend is exactly the one which
+  // is given.
+  return EVFLAG_NOENV | config.backend;
+}
+} // namespace
+
+struct ev_loop *init_default_event_loop(const EventLoopConfig &config) {
+  return ev_default_loop(event_loop_flags(config));
+}
+
+struct ev_loop *new_event_loop(const EventLoopConfig &config) {
+  return ev_loop_new(event_loop_flags(config));
+}
+
+namespace {
+void busypollcb(struct ev_loop *loop, ev_idle *w, int revents) {}
+} // namespace
+
+void run_event_loop(struct ev_loop *loop, const EventLoopConfig &config) {
+  if (!config.busy_poll) {
+    ev_run(loop, 0);
+    return;
+  }
+
+  // While an idle watcher is active, libev polls the backend with zero
+  // timeout instead of blocking.  It is unref'ed so that it does not
+  // keep the loop alive by itself.
+  ev_idle idle;
+
+  ev_idle_init(&idle, busypollcb);
+  ev_idle_start(loop, &idle);
+  ev_unref(loop);
+
+  ev_run(loop, 0);
+
+  ev_ref(loop);
+  ev_idle_stop(loop, &idle);
+}
+
+} // namespace ngtcp2
@@ -0,0 +1,79 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <optional>
+#include <string_view>
+
+#include <ev.h>
+
+namespace ngtcp2 {
+
+// EventLoopConfig selects the backend of the libev event loops, and
+// how they are run.  The watchers are registered in the same way
+// whichever backend is chosen, so that the same QUIC logic can be
+// compared across them.
+struct EventLoopConfig {
+  // backend is EVBACKEND_* flag which the event loops use.  0 lets
+  // libev pick the best one available.
+  unsigned int backend;
+  // busy_poll, if true, makes the event loops poll the backend
+  // without blocking.  It trades a CPU core for the wake-up latency.
+  bool busy_poll;
+};
+
+// parse_event_loop_backend returns EVBACKEND_* flag named |s|, or 0
+// if |s| is "auto".  It returns std::nullopt if |s| is unknown.
+// Whether the backend is available is only known when an event loop
+// is created.
+std::optional<unsigned int> parse_event_loop_backend(std::string_view s);
+
+// event_loop_backend_name returns the name of EVBACKEND_* flag
+// |backend|, or "unknown".
+std::string_view event_loop_backend_name(unsigned int backend);
+
+// init_default_event_loop creates the default event loop with
+// |config|.  It must be called before EV_DEFAULT is used first.  It
+// returns the default event loop, or nullptr if the backend is not
+// available.
+struct ev_loop *init_default_event_loop(const EventLoopConfig &config);
+
+// new_event_loop creates a new event loop with |config|.  It returns
+// nullptr if the backend is not available.
+struct ev_loop *new_event_loop(const EventLoopConfig &config);
+
+// run_event_loop runs |loop| like ev_run(loop, 0).  If
+// config.busy_poll is true, the backend is polled with zero timeout
+// until ev_break is called or no watcher is active.
+void run_event_loop(struct ev_loop *loop, const EventLoopConfig &config);
+
+} // namespace ngtcp2
+
+#endif // EVENT_LOOP_H
@@ -0,0 +1,47 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "event_loop_test.h"
+
+#include <CUnit/CUnit.h>
+
+#include "event_loop.h"
+
+namespace ngtcp2 {
+
+void test_event_loop_parse_backend() {
+  CU_ASSERT(0 == parse_event_loop_backend("auto"));
+  CU_ASSERT(EVBACKEND_SELECT == parse_event_loop_backend("select"));
+  CU_ASSERT(EVBACKEND_EPOLL == parse_event_loop_backend("epoll"));
+  CU_ASSERT(!parse_event_loop_backend(""));
+  CU_ASSERT(!parse_event_loop_backend("epol"));
+  CU_ASSERT(!parse_event_loop_backend("EPOLL"));
+
+  CU_ASSERT("epoll" == event_loop_backend_name(EVBACKEND_EPOLL));
+  CU_ASSERT("unknown" == event_loop_backend_name(0));
+  CU_ASSERT("unknown" ==
+            event_loop_backend_name(EVBACKEND_SELECT | EVBACKEND_POLL));
+}
+
+} // namespace ngtcp2
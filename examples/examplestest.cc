@@ -31,6 +31,24 @@
 #include <CUnit/Basic.h>
 // include test cases' include files here
 #include "util_test.h"
+#include "cid_map_test.h"
+#include "timer_wheel_test.h"
+#include "anti_replay_test.h"
+#include "file_cache_test.h"
+#include "path_cache_test.h"
+#include "resumption_cache_test.h"
+#include "file_writer_test.h"
+#include "qlog_ring_test.h"
+#include "dyn_pattern_test.h"
+#include "latency_histogram_test.h"
+#include "metrics_test.h"
+#include "xdp_test.h"
+#include "dpdk_test.h"
+#include "http_test.h"
+#include "event_loop_test.h"
+#include "netem_test.h"
+#include "coro_test.h"
+#include "cmd_queue_test.h"
 
 static int init_suite1(void) { return 0; }
 
@@ -59,13 +77,87 @@ int main(int argc, char *argv[]) {
                    ngtcp2::test_util_format_uint_iec) ||
       !CU_add_test(pSuite, "util_format_duration",
                    ngtcp2::test_util_format_duration) ||
+      !CU_add_test(pSuite, "util_format_http_date",
+                   ngtcp2::test_util_format_http_date) ||
       !CU_add_test(pSuite, "util_parse_uint", ngtcp2::test_util_parse_uint) ||
       !CU_add_test(pSuite, "util_parse_uint_iec",
                    ngtcp2::test_util_parse_uint_iec) ||
       !CU_add_test(pSuite, "util_parse_duration",
                    ngtcp2::test_util_parse_duration) ||
+      !CU_add_test(pSuite, "util_parse_cpu_list",
+                   ngtcp2::test_util_parse_cpu_list) ||
       !CU_add_test(pSuite, "util_normalize_path",
-                   ngtcp2::test_util_normalize_path)) {
+                   ngtcp2::test_util_normalize_path) ||
+      !CU_add_test(pSuite, "cid_map_find", ngtcp2::test_cid_map_find) ||
+      !CU_add_test(pSuite, "cid_map_erase", ngtcp2::test_cid_map_erase) ||
+      !CU_add_test(pSuite, "cid_map_grow", ngtcp2::test_cid_map_grow) ||
+      !CU_add_test(pSuite, "timer_wheel_expire",
+                   ngtcp2::test_timer_wheel_expire) ||
+      !CU_add_test(pSuite, "timer_wheel_cancel",
+                   ngtcp2::test_timer_wheel_cancel) ||
+      !CU_add_test(pSuite, "timer_wheel_levels",
+                   ngtcp2::test_timer_wheel_levels) ||
+      !CU_add_test(pSuite, "anti_replay_check_and_insert",
+                   ngtcp2::test_anti_replay_check_and_insert) ||
+      !CU_add_test(pSuite, "anti_replay_window",
+                   ngtcp2::test_anti_replay_window) ||
+      !CU_add_test(pSuite, "file_cache_lru", ngtcp2::test_file_cache_lru) ||
+      !CU_add_test(pSuite, "file_cache_insert",
+                   ngtcp2::test_file_cache_insert) ||
+      !CU_add_test(pSuite, "dyn_pattern_checksum",
+                   ngtcp2::test_dyn_pattern_checksum) ||
+      !CU_add_test(pSuite, "latency_histogram_bucket",
+                   ngtcp2::test_latency_histogram_bucket) ||
+      !CU_add_test(pSuite, "latency_histogram_percentile",
+                   ngtcp2::test_latency_histogram_percentile) ||
+      !CU_add_test(pSuite, "path_cache_key", ngtcp2::test_path_cache_key) ||
+      !CU_add_test(pSuite, "path_cache_get", ngtcp2::test_path_cache_get) ||
+      !CU_add_test(pSuite, "path_cache_save_load",
+                   ngtcp2::test_path_cache_save_load) ||
+      !CU_add_test(pSuite, "resumption_cache_get",
+                   ngtcp2::test_resumption_cache_get) ||
+      !CU_add_test(pSuite, "resumption_cache_save_load",
+                   ngtcp2::test_resumption_cache_save_load) ||
+      !CU_add_test(pSuite, "file_writer_write",
+                   ngtcp2::test_file_writer_write) ||
+      !CU_add_test(pSuite, "qlog_ring_append",
+                   ngtcp2::test_qlog_ring_append) ||
+      !CU_add_test(pSuite, "qlog_ring_overwrite",
+                   ngtcp2::test_qlog_ring_overwrite) ||
+      !CU_add_test(pSuite, "metrics_histogram",
+                   ngtcp2::test_metrics_histogram) ||
+      !CU_add_test(pSuite, "metrics_format", ngtcp2::test_metrics_format) ||
+      !CU_add_test(pSuite, "xdp_udp_frame_ipv4",
+                   ngtcp2::test_xdp_udp_frame_ipv4) ||
+      !CU_add_test(pSuite, "xdp_udp_frame_ipv6",
+                   ngtcp2::test_xdp_udp_frame_ipv6) ||
+      !CU_add_test(pSuite, "xdp_parse_udp_frame_invalid",
+                   ngtcp2::test_xdp_parse_udp_frame_invalid) ||
+      !CU_add_test(pSuite, "xdp_neighbor_table",
+                   ngtcp2::test_xdp_neighbor_table) ||
+      !CU_add_test(pSuite, "dpdk_dcid_worker", ngtcp2::test_dpdk_dcid_worker) ||
+      !CU_add_test(pSuite, "http_is_safe_method",
+                   ngtcp2::test_http_is_safe_method) ||
+      !CU_add_test(pSuite, "http_parse_connect_udp_path",
+                   ngtcp2::test_http_parse_connect_udp_path) ||
+      !CU_add_test(pSuite, "http_parse_range",
+                   ngtcp2::test_http_parse_range) ||
+      !CU_add_test(pSuite, "http_parse_content_range",
+                   ngtcp2::test_http_parse_content_range) ||
+      !CU_add_test(pSuite, "http_datagram", ngtcp2::test_http_datagram) ||
+      !CU_add_test(pSuite, "event_loop_parse_backend",
+                   ngtcp2::test_event_loop_parse_backend) ||
+      !CU_add_test(pSuite, "netem_parse_config",
+                   ngtcp2::test_netem_parse_config) ||
+      !CU_add_test(pSuite, "netem_rate", ngtcp2::test_netem_rate) ||
+      !CU_add_test(pSuite, "netem_loss", ngtcp2::test_netem_loss) ||
+      !CU_add_test(pSuite, "coro_read", ngtcp2::test_coro_read) ||
+      !CU_add_test(pSuite, "coro_write", ngtcp2::test_coro_write) ||
+      !CU_add_test(pSuite, "coro_cancel", ngtcp2::test_coro_cancel) ||
+      !CU_add_test(pSuite, "mpsc_queue", ngtcp2::test_mpsc_queue) ||
+      !CU_add_test(pSuite, "mpsc_queue_threads",
+                   ngtcp2::test_mpsc_queue_threads) ||
+      !CU_add_test(pSuite, "cmd_queue_batch", ngtcp2::test_cmd_queue_batch)) {
     CU_cleanup_registry();
     return CU_get_error();
   }
@@ -0,0 +1,172 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <sys/mman.h>
+
+#include <array>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <nghttp3/nghttp3.h>
+
+enum FileEntryFlag {
+  FILE_ENTRY_TYPE_DIR = 0x1,
+};
+
+// FileEntry is a file served to clients.  The file is mapped into
+// memory, and the response headers which only depend on the file are
+// prepared in advance.  The mapping is released when the last
+// reference is dropped, so a Stream keeps serving the file even after
+// the entry is evicted from FileCache.
+struct FileEntry {
+  FileEntry() : len(0), map(MAP_FAILED), flags(0), nvlen(0) {}
+  FileEntry(const FileEntry &) = delete;
+  FileEntry &operator=(const FileEntry &) = delete;
+
+  ~FileEntry() {
+    if (map != MAP_FAILED) {
+      munmap(map, len);
+    }
+  }
+
+  uint64_t len;
+  // map is the mapping of the file, or MAP_FAILED if the file is not
+  // mapped, e.g., it is a directory or an empty file.
+  void *map;
+  uint8_t flags;
+  // etag is the value of etag header field.  It is derived from the
+  // modification time and the length of the file.
+  std::string etag;
+  // content_length is len formatted as a decimal string.
+  std::string content_length;
+  // content_type is the value of content-type header field.
+  std::string content_type;
+  // nva is the response header fields built from the above fields,
+  // so that a response to this file needs no formatting.  The first
+  // nvlen entries are used.
+  std::array<nghttp3_nv, 5> nva;
+  size_t nvlen;
+};
+
+// FileCache is an LRU cache of FileEntry which is shared by all
+// workers.  It is keyed by the normalized path of the file, and holds
+// at most |capacity| bytes of files.  Directories are cached as well,
+// and they are accounted as zero bytes.
+class FileCache {
+public:
+  explicit FileCache(uint64_t capacity) : capacity_(capacity), bytes_(0) {}
+
+  FileCache(const FileCache &) = delete;
+  FileCache &operator=(const FileCache &) = delete;
+
+  // find returns the entry for |path|, and marks it as the most
+  // recently used one.  It returns nullptr if |path| is not cached.
+  std::shared_ptr<FileEntry> find(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mu_);
+
+    auto it = index_.find(path);
+    if (it == std::end(index_)) {
+      return nullptr;
+    }
+
+    lru_.splice(std::begin(lru_), lru_, (*it).second);
+
+    return (*it).second->fe;
+  }
+
+  // insert adds |fe| for |path|, and evicts the least recently used
+  // entries until the cache fits in its capacity.  If |path| has been
+  // cached by another worker in the meantime, the cached entry is
+  // returned instead of |fe|.  If |fe| is larger than the capacity, it
+  // is not cached, and |fe| is returned.
+  std::shared_ptr<FileEntry> insert(const std::string &path,
+                                    std::shared_ptr<FileEntry> fe) {
+    std::lock_guard<std::mutex> lock(mu_);
+
+    if (auto it = index_.find(path); it != std::end(index_)) {
+      lru_.splice(std::begin(lru_), lru_, (*it).second);
+
+      return (*it).second->fe;
+    }
+
+    if (fe->len > capacity_) {
+      return fe;
+    }
+
+    while (bytes_ + fe->len > capacity_) {
+      auto &victim = lru_.back();
+
+      bytes_ -= victim.fe->len;
+      index_.erase(victim.path);
+      lru_.pop_back();
+    }
+
+    bytes_ += fe->len;
+    lru_.push_front({path, fe});
+    index_.emplace(path, std::begin(lru_));
+
+    return fe;
+  }
+
+  // size returns the number of cached entries.
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mu_);
+
+    return lru_.size();
+  }
+
+  // bytes returns the total length of cached files.
+  uint64_t bytes() const {
+    std::lock_guard<std::mutex> lock(mu_);
+
+    return bytes_;
+  }
+
+private:
+  struct Node {
+    std::string path;
+    std::shared_ptr<FileEntry> fe;
+  };
+
+  mutable std::mutex mu_;
+  // lru_ is ordered from the most recently used entry to the least
+  // recently used one.
+  std::list<Node> lru_;
+  std::unordered_map<std::string, std::list<Node>::iterator> index_;
+  uint64_t capacity_;
+  uint64_t bytes_;
+};
+
+#endif // FILE_CACHE_H
@@ -0,0 +1,102 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "file_cache_test.h"
+
+#include <CUnit/CUnit.h>
+
+#include "file_cache.h"
+
+namespace ngtcp2 {
+
+namespace {
+std::shared_ptr<FileEntry> make_entry(uint64_t len) {
+  auto fe = std::make_shared<FileEntry>();
+  fe->len = len;
+  return fe;
+}
+} // namespace
+
+void test_file_cache_lru() {
+  FileCache cache(300);
+
+  CU_ASSERT(nullptr == cache.find("/a"));
+
+  auto a = cache.insert("/a", make_entry(100));
+  auto b = cache.insert("/b", make_entry(100));
+  auto c = cache.insert("/c", make_entry(100));
+
+  CU_ASSERT(3 == cache.size());
+  CU_ASSERT(300 == cache.bytes());
+  CU_ASSERT(a == cache.find("/a"));
+
+  // /b is the least recently used one.
+  auto d = cache.insert("/d", make_entry(100));
+
+  CU_ASSERT(3 == cache.size());
+  CU_ASSERT(300 == cache.bytes());
+  CU_ASSERT(nullptr == cache.find("/b"));
+  CU_ASSERT(a == cache.find("/a"));
+  CU_ASSERT(c == cache.find("/c"));
+  CU_ASSERT(d == cache.find("/d"));
+
+  // The evicted entry is still usable by its owner.
+  CU_ASSERT(100 == b->len);
+
+  // Evict as many entries as needed.
+  auto e = cache.insert("/e", make_entry(250));
+
+  CU_ASSERT(1 == cache.size());
+  CU_ASSERT(250 == cache.bytes());
+  CU_ASSERT(e == cache.find("/e"));
+
+  // Directories do not count.
+  cache.insert("/dir", make_entry(0));
+
+  CU_ASSERT(2 == cache.size());
+  CU_ASSERT(250 == cache.bytes());
+}
+
+void test_file_cache_insert() {
+  FileCache cache(100);
+
+  auto a = cache.insert("/a", make_entry(10));
+
+  // The entry cached first wins.
+  auto a2 = make_entry(10);
+
+  CU_ASSERT(a == cache.insert("/a", a2));
+  CU_ASSERT(1 == cache.size());
+  CU_ASSERT(10 == cache.bytes());
+
+  // An entry larger than the capacity is not cached.
+  auto big = make_entry(101);
+
+  CU_ASSERT(big == cache.insert("/big", big));
+  CU_ASSERT(nullptr == cache.find("/big"));
+  CU_ASSERT(1 == cache.size());
+  CU_ASSERT(a == cache.find("/a"));
+}
+
+} // namespace ngtcp2
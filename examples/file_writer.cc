@@ -0,0 +1,157 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "file_writer.h"
+
+#include <cerrno>
+#include <system_error>
+#include <cstring>
+#include <iostream>
+
+#include <unistd.h>
+
+FileWriter::FileWriter() : stop_(false), nerrors_(0) {}
+
+FileWriter::~FileWriter() { stop(); }
+
+int FileWriter::start() {
+  try {
+    thread_ = std::thread([this]() { run(); });
+  } catch (const std::system_error &e) {
+    std::cerr << "Could not start file writer thread: " << e.what()
+              << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+void FileWriter::stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lg(mu_);
+    stop_ = true;
+  }
+
+  cv_.notify_one();
+  thread_.join();
+}
+
+void FileWriter::write(int fd, uint64_t offset, const uint8_t *data,
+                       size_t datalen) {
+  if (datalen == 0) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lg(mu_);
+    chunks_.push_back(Chunk{
+      .fd = fd,
+      .offset = offset,
+      .data = std::vector<uint8_t>(data, data + datalen),
+      .close = false,
+    });
+  }
+
+  cv_.notify_one();
+}
+
+void FileWriter::close(int fd) {
+  {
+    std::lock_guard<std::mutex> lg(mu_);
+    chunks_.push_back(Chunk{
+      .fd = fd,
+      .offset = 0,
+      .data = {},
+      .close = true,
+    });
+  }
+
+  cv_.notify_one();
+}
+
+size_t FileWriter::nerrors() const { return nerrors_; }
+
+namespace {
+int write_at(int fd, uint64_t offset, const uint8_t *data, size_t datalen) {
+  while (datalen) {
+    auto nwrite = pwrite(fd, data, datalen, static_cast<off_t>(offset));
+    if (nwrite == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      std::cerr << "pwrite: " << strerror(errno) << std::endl;
+
+      return -1;
+    }
+
+    data += nwrite;
+    datalen -= static_cast<size_t>(nwrite);
+    offset += static_cast<uint64_t>(nwrite);
+  }
+
+  return 0;
+}
+} // namespace
+
+void FileWriter::run() {
+  std::deque<Chunk> chunks;
+
+  for (;;) {
+    bool stop;
+
+    {
+      std::unique_lock<std::mutex> lk(mu_);
+      cv_.wait(lk, [this]() { return stop_ || !chunks_.empty(); });
+
+      stop = stop_;
+
+      chunks.swap(chunks_);
+    }
+
+    for (auto &c : chunks) {
+      if (c.close) {
+        ::close(c.fd);
+        continue;
+      }
+
+      if (write_at(c.fd, c.offset, c.data.data(), c.data.size()) != 0) {
+        ++nerrors_;
+      }
+    }
+
+    chunks.clear();
+
+    if (stop) {
+      std::lock_guard<std::mutex> lg(mu_);
+      if (chunks_.empty()) {
+        return;
+      }
+    }
+  }
+}
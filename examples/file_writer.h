@@ -0,0 +1,93 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef FILE_WRITER_H
+#define FILE_WRITER_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// FileWriter writes data to files with pwrite(2) in a background
+// thread, so that the event loop does not block on disk I/O.  Since
+// each chunk carries its file offset, the chunks of a file can be
+// written in any order, e.g., the segments of a download which
+// arrive on the different streams.
+class FileWriter {
+public:
+  FileWriter();
+  ~FileWriter();
+
+  FileWriter(const FileWriter &) = delete;
+  FileWriter &operator=(const FileWriter &) = delete;
+
+  // start starts the background thread.  It returns 0 if it
+  // succeeds, or -1.
+  int start();
+  // stop writes all queued chunks, closes the files queued by close,
+  // and joins the background thread.
+  void stop();
+
+  // write queues |data| of length |datalen| to be written to |fd| at
+  // |offset|.  |data| is copied.  It is safe to call from any thread.
+  void write(int fd, uint64_t offset, const uint8_t *data, size_t datalen);
+  // close closes |fd| after all chunks queued for it so far are
+  // written.
+  void close(int fd);
+
+  // nerrors returns the number of chunks which could not be written.
+  size_t nerrors() const;
+
+private:
+  struct Chunk {
+    int fd;
+    uint64_t offset;
+    // data is the data to write.  The chunk which closes fd has no
+    // data.
+    std::vector<uint8_t> data;
+    bool close;
+  };
+
+  void run();
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  // chunks_ is the queue of the chunks to write.  Guarded by mu_.
+  std::deque<Chunk> chunks_;
+  // stop_ is true if the background thread should exit after the
+  // queue is drained.  Guarded by mu_.
+  bool stop_;
+  std::atomic<size_t> nerrors_;
+  std::thread thread_;
+};
+
+#endif // FILE_WRITER_H
@@ -0,0 +1,75 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "file_writer_test.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <CUnit/CUnit.h>
+
+#include "file_writer.h"
+
+namespace ngtcp2 {
+
+void test_file_writer_write() {
+  char path[] = "/tmp/file_writer_test.XXXXXX";
+  auto fd = mkstemp(path);
+
+  CU_ASSERT(fd != -1);
+
+  auto rfd = open(path, O_RDONLY);
+
+  unlink(path);
+
+  CU_ASSERT(rfd != -1);
+
+  FileWriter writer;
+
+  CU_ASSERT(0 == writer.start());
+
+  // The chunks may be written in any order.
+  writer.write(fd, 6, reinterpret_cast<const uint8_t *>("world"), 5);
+  writer.write(fd, 0, reinterpret_cast<const uint8_t *>("hello "), 6);
+  writer.close(fd);
+  writer.stop();
+
+  CU_ASSERT(0 == writer.nerrors());
+
+  char buf[16];
+  auto nread = pread(rfd, buf, sizeof(buf), 0);
+
+  CU_ASSERT(11 == nread);
+  CU_ASSERT(0 == memcmp("hello world", buf, 11));
+
+  // fd has been closed by writer.
+  CU_ASSERT(-1 == ::close(fd));
+
+  close(rfd);
+}
+
+} // namespace ngtcp2
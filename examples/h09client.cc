@@ -186,7 +186,8 @@ Client::Client(struct ev_loop *loop, uint32_t client_chosen_version,
       early_data_(false),
       should_exit_(false),
       handshake_confirmed_(false),
-      tx_{} {
+      tx_{},
+      bench_stats_{} {
   ev_io_init(&wev_, writecb, 0, EV_WRITE);
   wev_.data = this;
   ev_timer_init(&timer_, timeoutcb, 0., 0.);
@@ -632,7 +633,7 @@ int Client::init(int fd, const Address &local_addr, const Address &remote_addr,
 
   ngtcp2_settings settings;
   ngtcp2_settings_default(&settings);
-  settings.log_printf = config.quiet ? nullptr : debug::log_printf;
+  settings.log_record = config.quiet ? nullptr : debug::log_record;
   if (!config.qlog_file.empty() || !config.qlog_dir.empty()) {
     std::string path;
     if (!config.qlog_file.empty()) {
@@ -811,6 +812,10 @@ int Client::on_read(const Endpoint &ep) {
       break;
     }
 
+    ++bench_stats_.nrecv_call;
+    ++bench_stats_.nrecv_pkt;
+    bench_stats_.nrecv_bytes += static_cast<uint64_t>(nread);
+
     pi.ecn = msghdr_get_ecn(&msg, su.storage.ss_family);
 
     if (!config.quiet) {
@@ -1368,6 +1373,10 @@ int Client::send_packet(const Endpoint &ep, const ngtcp2_addr &remote_addr,
 
   assert(static_cast<size_t>(nwrite) == datalen);
 
+  ++bench_stats_.nsend_call;
+  ++bench_stats_.nsend_pkt;
+  bench_stats_.nsend_bytes += static_cast<uint64_t>(nwrite);
+
   if (!config.quiet) {
     std::cerr << "Sent packet: local="
               << util::straddr(&ep.addr.su.sa, ep.addr.len) << " remote="
@@ -1571,6 +1580,12 @@ int Client::recv_stream_data(uint32_t flags, int64_t stream_id,
   ngtcp2_conn_extend_max_stream_offset(conn_, stream_id, datalen);
   ngtcp2_conn_extend_max_offset(conn_, datalen);
 
+  if (config.bench_download) {
+    bench_stats_on_body(bench_stats_, datalen, util::timestamp(loop_));
+
+    return 0;
+  }
+
   if (stream->fd == -1) {
     return 0;
   }
@@ -1662,9 +1677,14 @@ const std::vector<uint32_t> &Client::get_offered_versions() const {
   return offered_versions_;
 }
 
+const BenchStats &Client::bench_stats() const { return bench_stats_; }
+
 namespace {
-int run(Client &c, const char *addr, const char *port,
-        TLSClientContext &tls_ctx) {
+// start_connection creates a socket, and starts the connection of
+// |c| to |addr| and |port|.  The event loop of |c| drives the rest
+// of it.
+int start_connection(Client &c, const char *addr, const char *port,
+                     TLSClientContext &tls_ctx) {
   Address remote_addr, local_addr;
 
   auto fd = create_sock(remote_addr, addr, port);
@@ -1701,7 +1721,50 @@ int run(Client &c, const char *addr, const char *port,
     return rv;
   }
 
-  ev_run(EV_DEFAULT, 0);
+  return 0;
+}
+} // namespace
+
+namespace {
+int run(Client &c, const char *addr, const char *port,
+        TLSClientContext &tls_ctx) {
+  if (auto rv = start_connection(c, addr, port, tls_ctx); rv != 0) {
+    return rv;
+  }
+
+  run_event_loop(EV_DEFAULT, config.event_loop);
+
+  return 0;
+}
+} // namespace
+
+namespace {
+// run_parallel makes config.bench_connections connections to |addr|
+// and |port| in parallel on the default event loop, and adds their
+// statistics to |st|.
+int run_parallel(BenchStats &st, const char *addr, const char *port,
+                 TLSClientContext &tls_ctx) {
+  std::vector<std::unique_ptr<Client>> clients;
+
+  clients.reserve(config.bench_connections);
+
+  for (size_t i = 0; i < config.bench_connections; ++i) {
+    auto c = std::make_unique<Client>(EV_DEFAULT, config.version,
+                                      config.version);
+
+    if (start_connection(*c, addr, port, tls_ctx) != 0) {
+      return -1;
+    }
+
+    clients.push_back(std::move(c));
+  }
+
+  // The loop returns when all connections are closed.
+  run_event_loop(EV_DEFAULT, config.event_loop);
+
+  for (auto &c : clients) {
+    add_bench_stats(st, c->bench_stats());
+  }
 
   return 0;
 }
@@ -1800,6 +1863,7 @@ void config_set_default(Config &config) {
   config.cc_algo = NGTCP2_CC_ALGO_CUBIC;
   config.initial_rtt = NGTCP2_DEFAULT_INITIAL_RTT;
   config.handshake_timeout = NGTCP2_DEFAULT_HANDSHAKE_TIMEOUT;
+  config.bench_connections = 1;
 }
 } // namespace
 
@@ -1955,7 +2019,7 @@ Options:
               Exit when all HTTP streams are closed.
   --disable-early-data
               Disable early data.
-  --cc=(cubic|reno|bbr|bbr2)
+  --cc=(cubic|reno|bbr|bbr2|prague)
               The name of congestion controller algorithm.
               Default: )"
             << util::strccalgo(config.cc_algo) << R"(
@@ -1976,6 +2040,26 @@ Options:
               Default: )"
             << util::format_duration(config.handshake_timeout) << R"(
   --no-pmtud  Disables Path MTU Discovery.
+  --bench-download
+              Discard response bodies as soon as  they are received,
+              and print the goodput, CPU usage, datagrams per syscall,
+              and bytes per datagram when client exits.
+  --bench-connections=<N>
+              Make <N> connections in parallel, each of which sends
+              --nstreams requests.  It implies
+              --exit-on-all-streams-close.
+              Default: )"
+            << config.bench_connections << R"(
+  --event-loop=<BACKEND>
+              The backend of  the event loops: auto, select, poll,
+              epoll, kqueue, port, linuxaio, or io_uring.  It must be
+              supported by  libev and the kernel.   auto lets libev
+              choose.
+              Default: auto
+  --event-loop-busy-poll
+              Poll the backend of the event loops  without blocking
+              instead of sleeping until an event arrives.  It lowers
+              the wake-up latency at the cost of a busy CPU core.
   -h, --help  Display this help and exit.
 
 ---
@@ -2049,6 +2133,10 @@ int main(int argc, char **argv) {
         {"other-versions", required_argument, &flag, 37},
         {"no-pmtud", no_argument, &flag, 38},
         {"preferred-versions", required_argument, &flag, 39},
+        {"event-loop", required_argument, &flag, 40},
+        {"event-loop-busy-poll", no_argument, &flag, 41},
+        {"bench-download", no_argument, &flag, 42},
+        {"bench-connections", required_argument, &flag, 43},
         {nullptr, 0, nullptr, 0},
     };
 
@@ -2306,7 +2394,12 @@ int main(int argc, char **argv) {
           config.cc_algo = NGTCP2_CC_ALGO_BBR2;
           break;
         }
-        std::cerr << "cc: specify cubic, reno, bbr, or bbr2" << std::endl;
+        if (strcmp("prague", optarg) == 0) {
+          config.cc_algo = NGTCP2_CC_ALGO_PRAGUE;
+          break;
+        }
+        std::cerr << "cc: specify cubic, reno, bbr, bbr2, or prague"
+                  << std::endl;
         exit(EXIT_FAILURE);
       case 28:
         // --exit-on-all-streams-close
@@ -2418,6 +2511,35 @@ int main(int argc, char **argv) {
         }
         break;
       }
+      case 40:
+        // --event-loop
+        if (auto b = parse_event_loop_backend(optarg); !b) {
+          std::cerr << "event-loop: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.event_loop.backend = *b;
+        }
+        break;
+      case 41:
+        // --event-loop-busy-poll
+        config.event_loop.busy_poll = true;
+        break;
+      case 42:
+        // --bench-download
+        config.bench_download = true;
+        break;
+      case 43:
+        // --bench-connections
+        if (auto n = util::parse_uint(optarg); !n) {
+          std::cerr << "bench-connections: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else if (*n == 0) {
+          std::cerr << "bench-connections: must not be 0" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.bench_connections = *n;
+        }
+        break;
       }
       break;
     default:
@@ -2443,6 +2565,17 @@ int main(int argc, char **argv) {
     exit(EXIT_FAILURE);
   }
 
+  if (config.bench_connections > 1) {
+    if (!config.preferred_versions.empty()) {
+      std::cerr << "bench-connections: --preferred-versions is not supported"
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    config.exit_on_first_stream_close = false;
+    config.exit_on_all_streams_close = true;
+  }
+
   if (data_path) {
     auto fd = open(data_path, O_RDONLY);
     if (fd == -1) {
@@ -2503,6 +2636,11 @@ int main(int argc, char **argv) {
     exit(EXIT_FAILURE);
   }
 
+  if (!init_default_event_loop(config.event_loop)) {
+    std::cerr << "ev_default_loop: Could not create event loop" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
   auto ev_loop_d = defer(ev_loop_destroy, EV_DEFAULT);
 
   auto keylog_filename = getenv("SSLKEYLOGFILE");
@@ -2519,6 +2657,21 @@ int main(int argc, char **argv) {
     exit(EXIT_FAILURE);
   }
 
+  BenchStats bst{};
+  auto cpu_start = process_cpu_time();
+
+  if (config.bench_connections > 1) {
+    if (run_parallel(bst, addr, port, tls_ctx) != 0) {
+      exit(EXIT_FAILURE);
+    }
+
+    if (config.bench_download) {
+      print_bench_stats(bst, process_cpu_time() - cpu_start);
+    }
+
+    return EXIT_SUCCESS;
+  }
+
   auto client_chosen_version = config.version;
 
   for (;;) {
@@ -2528,6 +2681,8 @@ int main(int argc, char **argv) {
       exit(EXIT_FAILURE);
     }
 
+    add_bench_stats(bst, c.bench_stats());
+
     if (config.preferred_versions.empty()) {
       break;
     }
@@ -2552,5 +2707,9 @@ int main(int argc, char **argv) {
     }
   }
 
+  if (config.bench_download) {
+    print_bench_stats(bst, process_cpu_time() - cpu_start);
+  }
+
   return EXIT_SUCCESS;
 }
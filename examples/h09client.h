@@ -140,6 +140,7 @@ public:
   int send_blocked_packet();
 
   const std::vector<uint32_t> &get_offered_versions() const;
+  const BenchStats &bench_stats() const;
 
 private:
   std::vector<Endpoint> endpoints_;
@@ -186,6 +187,7 @@ private:
     } blocked;
     std::array<uint8_t, 64_k> data;
   } tx_;
+  BenchStats bench_stats_;
 };
 
 #endif // CLIENT_H
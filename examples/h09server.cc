@@ -64,6 +64,11 @@ namespace {
 constexpr size_t max_preferred_versionslen = 4;
 } // namespace
 
+namespace {
+// tx_bufsize is the size of buffer to write a single GSO batch.
+constexpr size_t tx_bufsize = 64_k;
+} // namespace
+
 namespace {
 auto randgen = util::make_mt19937();
 } // namespace
@@ -208,6 +213,13 @@ namespace {
 std::unordered_map<std::string, FileEntry> file_cache;
 } // namespace
 
+namespace {
+// bench_body is the response body of config.bench_size bytes.  It is
+// an anonymous read-only mapping backed by the shared zero page, so
+// that all streams send it from the same memory.
+const uint8_t *bench_body;
+} // namespace
+
 std::pair<FileEntry, int> Stream::open_file(const std::string &path) {
   auto it = file_cache.find(path);
   if (it != std::end(file_cache)) {
@@ -269,6 +281,15 @@ int Stream::start_response() {
     return send_status_response(400);
   }
 
+  if (config.bench_size) {
+    respbuf.begin = respbuf.pos = const_cast<uint8_t *>(bench_body);
+    respbuf.end = respbuf.last = respbuf.begin + config.bench_size;
+
+    handler->add_sendq(this);
+
+    return 0;
+  }
+
   auto req = request_path(uri);
   if (req.path.empty()) {
     return send_status_response(400);
@@ -391,9 +412,7 @@ Handler::Handler(struct ev_loop *loop, Server *server)
           true
 #endif // !UDP_SEGMENT
       },
-      tx_{
-          .data = std::unique_ptr<uint8_t[]>(new uint8_t[64_k]),
-      } {
+      tx_{} {
   ev_io_init(&wev_, writecb, 0, EV_WRITE);
   wev_.data = this;
   ev_timer_init(&timer_, timeoutcb, 0., 0.);
@@ -411,6 +430,10 @@ Handler::~Handler() {
   if (qlog_) {
     fclose(qlog_);
   }
+
+  if (tx_.data) {
+    server_->release_txbuf(std::move(tx_.data));
+  }
 }
 
 namespace {
@@ -645,7 +668,7 @@ int Handler::extend_max_stream_data(int64_t stream_id, uint64_t max_data) {
   auto &stream = (*it).second;
 
   if (nghttp3_buf_len(&stream->respbuf)) {
-    sendq_.emplace(stream.get());
+    add_sendq(stream.get());
   }
 
   return 0;
@@ -719,7 +742,7 @@ int Handler::init(const Endpoint &ep, const Address &local_addr,
 
   ngtcp2_settings settings;
   ngtcp2_settings_default(&settings);
-  settings.log_printf = config.quiet ? nullptr : debug::log_printf;
+  settings.log_record = config.quiet ? nullptr : debug::log_record;
   settings.initial_ts = util::timestamp(loop_);
   settings.token = ngtcp2_vec{const_cast<uint8_t *>(token), tokenlen};
   settings.cc_algo = config.cc_algo;
@@ -937,7 +960,11 @@ int Handler::on_write() {
     }
   }
 
-  if (auto rv = write_streams(); rv != 0) {
+  auto rv = write_streams();
+
+  release_txbuf();
+
+  if (rv != 0) {
     return rv;
   }
 
@@ -955,8 +982,13 @@ int Handler::write_streams() {
   auto path_max_udp_payload_size =
       ngtcp2_conn_get_path_max_udp_payload_size(conn_);
   size_t max_pktcnt =
-      std::min(static_cast<size_t>(64_k), ngtcp2_conn_get_send_quantum(conn_)) /
+      std::min(tx_bufsize, ngtcp2_conn_get_send_quantum(conn_)) /
       max_udp_payload_size;
+
+  if (!tx_.data) {
+    tx_.data = server_->acquire_txbuf();
+  }
+
   uint8_t *bufpos = tx_.data.get();
   ngtcp2_pkt_info pi;
   size_t gso_size = 0;
@@ -979,10 +1011,12 @@ int Handler::write_streams() {
     uint32_t flags = NGTCP2_WRITE_STREAM_FLAG_MORE;
     Stream *stream = nullptr;
 
-    if (!sendq_.empty() && ngtcp2_conn_get_max_data_left(conn_)) {
-      stream = *std::begin(sendq_);
+    if (ngtcp2_conn_get_max_data_left(conn_) &&
+        (stream_id = ngtcp2_conn_get_scheduled_stream(conn_)) != -1) {
+      auto it = streams_.find(stream_id);
+      assert(it != std::end(streams_));
+      stream = (*it).second.get();
 
-      stream_id = stream->stream_id;
       vec.base = stream->respbuf.pos;
       vec.len = nghttp3_buf_len(&stream->respbuf);
       vcnt = 1;
@@ -999,14 +1033,14 @@ int Handler::write_streams() {
       case NGTCP2_ERR_STREAM_DATA_BLOCKED:
       case NGTCP2_ERR_STREAM_SHUT_WR:
         assert(ndatalen == -1);
-        sendq_.erase(std::begin(sendq_));
+        ngtcp2_conn_unschedule_stream(conn_, stream_id);
         continue;
       case NGTCP2_ERR_WRITE_MORE:
+        // The library unschedules the stream when it sends fin.
         assert(ndatalen >= 0);
         stream->respbuf.pos += ndatalen;
-        if (nghttp3_buf_len(&stream->respbuf) == 0) {
-          sendq_.erase(std::begin(sendq_));
-        }
+        bench_stats_on_body(server_->bench_stats(),
+                            static_cast<size_t>(ndatalen), ts);
         continue;
       }
 
@@ -1019,9 +1053,8 @@ int Handler::write_streams() {
       return handle_error();
     } else if (ndatalen >= 0) {
       stream->respbuf.pos += ndatalen;
-      if (nghttp3_buf_len(&stream->respbuf) == 0) {
-        sendq_.erase(std::begin(sendq_));
-      }
+      bench_stats_on_body(server_->bench_stats(),
+                          static_cast<size_t>(ndatalen), ts);
     }
 
     if (nwrite == 0) {
@@ -1195,9 +1228,19 @@ int Handler::send_blocked_packet() {
   tx_.num_blocked = 0;
   tx_.num_blocked_sent = 0;
 
+  release_txbuf();
+
   return 0;
 }
 
+void Handler::release_txbuf() {
+  if (!tx_.data || tx_.send_blocked) {
+    return;
+  }
+
+  server_->release_txbuf(std::move(tx_.data));
+}
+
 void Handler::signal_write() { ev_io_start(loop_, &wev_); }
 
 void Handler::start_draining_period() {
@@ -1435,9 +1478,6 @@ int Handler::on_stream_close(int64_t stream_id, uint64_t app_error_code) {
 
   auto it = streams_.find(stream_id);
   assert(it != std::end(streams_));
-  auto &stream = (*it).second;
-
-  sendq_.erase(stream.get());
 
   if (!config.quiet) {
     std::cerr << "HTTP stream " << stream_id << " closed with error code "
@@ -1458,7 +1498,9 @@ void Handler::shutdown_read(int64_t stream_id, int app_error_code) {
   ngtcp2_conn_shutdown_stream_read(conn_, stream_id, app_error_code);
 }
 
-void Handler::add_sendq(Stream *stream) { sendq_.emplace(stream); }
+void Handler::add_sendq(Stream *stream) {
+  ngtcp2_conn_schedule_stream(conn_, stream->stream_id);
+}
 
 namespace {
 void sreadcb(struct ev_loop *loop, ev_io *w, int revents) {
@@ -1475,7 +1517,7 @@ void siginthandler(struct ev_loop *loop, ev_signal *watcher, int revents) {
 } // namespace
 
 Server::Server(struct ev_loop *loop, TLSServerContext &tls_ctx)
-    : loop_(loop), tls_ctx_(tls_ctx) {
+    : loop_(loop), tls_ctx_(tls_ctx), bench_stats_{} {
   ev_signal_init(&sigintev_, siginthandler, SIGINT);
 }
 
@@ -1744,6 +1786,10 @@ int Server::on_read(Endpoint &ep) {
 
     ++pktcnt;
 
+    ++bench_stats_.nrecv_call;
+    ++bench_stats_.nrecv_pkt;
+    bench_stats_.nrecv_bytes += static_cast<uint64_t>(nread);
+
     pi.ecn = msghdr_get_ecn(&msg, su.storage.ss_family);
     auto local_addr = msghdr_get_local_addr(&msg, su.storage.ss_family);
     if (!local_addr) {
@@ -1792,10 +1838,8 @@ int Server::on_read(Endpoint &ep) {
       continue;
     }
 
-    auto dcid_key = util::make_cid_key(vc.dcid, vc.dcidlen);
-
-    auto handler_it = handlers_.find(dcid_key);
-    if (handler_it == std::end(handlers_)) {
+    auto ph = handlers_.find(vc.dcid, vc.dcidlen);
+    if (!ph) {
       switch (auto rv = ngtcp2_accept(&hd, buf.data(), nread); rv) {
       case 0:
         break;
@@ -1901,17 +1945,17 @@ int Server::on_read(Endpoint &ep) {
       ngtcp2_conn_get_scid(conn, scids.data());
 
       for (size_t i = 0; i < num_scid; ++i) {
-        handlers_.emplace(util::make_cid_key(&scids[i]), h.get());
+        handlers_.emplace(&scids[i], h.get());
       }
 
-      handlers_.emplace(dcid_key, h.get());
+      handlers_.emplace(vc.dcid, vc.dcidlen, h.get());
 
       h.release();
 
       continue;
     }
 
-    auto h = (*handler_it).second;
+    auto h = *ph;
     auto conn = h->conn();
     if (ngtcp2_conn_is_in_closing_period(conn)) {
       // TODO do exponential backoff.
@@ -2341,6 +2385,11 @@ Server::send_packet(Endpoint &ep, bool &no_gso, const ngtcp2_addr &local_addr,
     return {0, NETWORK_ERR_OK};
   }
 
+  ++bench_stats_.nsend_call;
+  bench_stats_.nsend_pkt +=
+      (static_cast<size_t>(nwrite) + gso_size - 1) / gso_size;
+  bench_stats_.nsend_bytes += static_cast<uint64_t>(nwrite);
+
   if (!config.quiet) {
     std::cerr << "Sent packet: local="
               << util::straddr(local_addr.addr, local_addr.addrlen)
@@ -2354,24 +2403,40 @@ Server::send_packet(Endpoint &ep, bool &no_gso, const ngtcp2_addr &local_addr,
 }
 
 void Server::associate_cid(const ngtcp2_cid *cid, Handler *h) {
-  handlers_.emplace(util::make_cid_key(cid), h);
+  handlers_.emplace(cid, h);
 }
 
 void Server::dissociate_cid(const ngtcp2_cid *cid) {
-  handlers_.erase(util::make_cid_key(cid));
+  handlers_.erase(cid);
+}
+
+BenchStats &Server::bench_stats() { return bench_stats_; }
+
+std::unique_ptr<uint8_t[]> Server::acquire_txbuf() {
+  if (txbufs_.empty()) {
+    return std::unique_ptr<uint8_t[]>(new uint8_t[tx_bufsize]);
+  }
+
+  auto buf = std::move(txbufs_.back());
+  txbufs_.pop_back();
+
+  return buf;
+}
+
+void Server::release_txbuf(std::unique_ptr<uint8_t[]> buf) {
+  txbufs_.push_back(std::move(buf));
 }
 
 void Server::remove(const Handler *h) {
   auto conn = h->conn();
 
-  handlers_.erase(
-      util::make_cid_key(ngtcp2_conn_get_client_initial_dcid(conn)));
+  handlers_.erase(ngtcp2_conn_get_client_initial_dcid(conn));
 
   std::vector<ngtcp2_cid> cids(ngtcp2_conn_get_num_scid(conn));
   ngtcp2_conn_get_scid(conn, cids.data());
 
   for (auto &cid : cids) {
-    handlers_.erase(util::make_cid_key(&cid));
+    handlers_.erase(&cid);
   }
 
   delete h;
@@ -2570,7 +2635,7 @@ Options:
               The maximum length of a dynamically generated content.
               Default: )"
             << util::format_uint_iec(config.max_dyn_length) << R"(
-  --cc=(cubic|reno|bbr|bbr2)
+  --cc=(cubic|reno|bbr|bbr2|prague)
               The name of congestion controller algorithm.
               Default: )"
             << util::strccalgo(config.cc_algo) << R"(
@@ -2612,6 +2677,22 @@ Options:
               Override   ACK  threshold,   aka,   maximum  number   of
               unacknowledged   packets    before   sending    an   ACK
               immediately.
+  --event-loop=<BACKEND>
+              The backend of  the event loops: auto, select, poll,
+              epoll, kqueue, port, linuxaio, or io_uring.  It must be
+              supported by  libev and the kernel.   auto lets libev
+              choose.
+              Default: auto
+  --event-loop-busy-poll
+              Poll the backend of the event loops  without blocking
+              instead of sleeping until an event arrives.  It lowers
+              the wake-up latency at the cost of a busy CPU core.
+  --bench-size=<SIZE>
+              Respond to every request with a  synthetic body of <SIZE>
+              bytes  instead of a file, and print  the goodput,  CPU
+              usage, datagrams per syscall, and bytes per datagram
+              when server exits.  The bodies of all streams are sent
+              from a single read-only buffer.
   -h, --help  Display this help and exit.
 
 ---
@@ -2674,6 +2755,9 @@ int main(int argc, char **argv) {
         {"other-versions", required_argument, &flag, 28},
         {"no-pmtud", no_argument, &flag, 29},
         {"ack-thresh", required_argument, &flag, 30},
+        {"event-loop", required_argument, &flag, 31},
+        {"event-loop-busy-poll", no_argument, &flag, 32},
+        {"bench-size", required_argument, &flag, 33},
         {nullptr, 0, nullptr, 0}};
 
     auto optidx = 0;
@@ -2864,7 +2948,12 @@ int main(int argc, char **argv) {
           config.cc_algo = NGTCP2_CC_ALGO_BBR2;
           break;
         }
-        std::cerr << "cc: specify cubic, reno, bbr, or bbr2" << std::endl;
+        if (strcmp("prague", optarg) == 0) {
+          config.cc_algo = NGTCP2_CC_ALGO_PRAGUE;
+          break;
+        }
+        std::cerr << "cc: specify cubic, reno, bbr, bbr2, or prague"
+                  << std::endl;
         exit(EXIT_FAILURE);
       case 20:
         // --initial-rtt
@@ -2983,6 +3072,28 @@ int main(int argc, char **argv) {
           config.ack_thresh = *n;
         }
         break;
+      case 31:
+        // --event-loop
+        if (auto b = parse_event_loop_backend(optarg); !b) {
+          std::cerr << "event-loop: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.event_loop.backend = *b;
+        }
+        break;
+      case 32:
+        // --event-loop-busy-poll
+        config.event_loop.busy_poll = true;
+        break;
+      case 33:
+        // --bench-size
+        if (auto n = util::parse_uint_iec(optarg); !n) {
+          std::cerr << "bench-size: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.bench_size = *n;
+        }
+        break;
       }
       break;
     default:
@@ -3030,6 +3141,11 @@ int main(int argc, char **argv) {
 
   std::cerr << "Using document root " << config.htdocs << std::endl;
 
+  if (!init_default_event_loop(config.event_loop)) {
+    std::cerr << "ev_default_loop: Could not create event loop" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
   auto ev_loop_d = defer(ev_loop_destroy, EV_DEFAULT);
 
   auto keylog_filename = getenv("SSLKEYLOGFILE");
@@ -3046,15 +3162,32 @@ int main(int argc, char **argv) {
     exit(EXIT_FAILURE);
   }
 
+  if (config.bench_size) {
+    auto p = mmap(nullptr, config.bench_size, PROT_READ,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+      std::cerr << "mmap: " << strerror(errno) << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    bench_body = static_cast<const uint8_t *>(p);
+  }
+
   Server s(EV_DEFAULT, tls_ctx);
   if (s.init(addr, port) != 0) {
     exit(EXIT_FAILURE);
   }
 
-  ev_run(EV_DEFAULT, 0);
+  auto cpu_start = process_cpu_time();
+
+  run_event_loop(EV_DEFAULT, config.event_loop);
 
   s.disconnect();
   s.close();
 
+  if (config.bench_size) {
+    print_bench_stats(s.bench_stats(), process_cpu_time() - cpu_start);
+  }
+
   return EXIT_SUCCESS;
 }
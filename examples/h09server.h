@@ -35,7 +35,6 @@
 #include <deque>
 #include <string_view>
 #include <memory>
-#include <set>
 
 #include <ngtcp2/ngtcp2.h>
 #include <ngtcp2/ngtcp2_crypto.h>
@@ -47,6 +46,7 @@
 #include "tls_server_context.h"
 #include "network.h"
 #include "shared.h"
+#include "cid_map.h"
 
 using namespace ngtcp2;
 
@@ -80,12 +80,6 @@ struct Stream {
   bool eos;
 };
 
-struct StreamIDLess {
-  constexpr bool operator()(const Stream *lhs, const Stream *rhs) const {
-    return lhs->stream_id < rhs->stream_id;
-  }
-};
-
 class Server;
 
 // Endpoint is a local endpoint.
@@ -152,6 +146,9 @@ public:
                        const uint8_t *data, size_t datalen, size_t gso_size);
   void start_wev_endpoint(const Endpoint &ep);
   int send_blocked_packet();
+  // release_txbuf returns tx buffer to Server unless blocked packets
+  // refer to it.
+  void release_txbuf();
 
 private:
   struct ev_loop *loop_;
@@ -161,7 +158,6 @@ private:
   FILE *qlog_;
   ngtcp2_cid scid_;
   std::unordered_map<int64_t, std::unique_ptr<Stream>> streams_;
-  std::set<Stream *, StreamIDLess> sendq_;
   // conn_closebuf_ contains a packet which contains CONNECTION_CLOSE.
   // This packet is repeatedly sent as a response to the incoming
   // packet in draining period.
@@ -184,6 +180,9 @@ private:
       size_t datalen;
       size_t gso_size;
     } blocked[2];
+    // data is the buffer which GSO batch is written to.  It is taken
+    // from Server only while it is in use, so that an idle
+    // connection does not hold it.
     std::unique_ptr<uint8_t[]> data;
   } tx_;
 };
@@ -222,16 +221,28 @@ public:
                                      unsigned int ecn, const uint8_t *data,
                                      size_t datalen, size_t gso_size);
   void remove(const Handler *h);
+  // acquire_txbuf returns the buffer which a connection writes GSO
+  // batch to.
+  std::unique_ptr<uint8_t[]> acquire_txbuf();
+  // release_txbuf puts |buf| obtained by acquire_txbuf back to the
+  // pool.
+  void release_txbuf(std::unique_ptr<uint8_t[]> buf);
 
   void associate_cid(const ngtcp2_cid *cid, Handler *h);
   void dissociate_cid(const ngtcp2_cid *cid);
 
+  BenchStats &bench_stats();
+
 private:
-  std::unordered_map<std::string, Handler *> handlers_;
+  CIDMap<Handler *> handlers_;
   struct ev_loop *loop_;
   std::vector<Endpoint> endpoints_;
   TLSServerContext &tls_ctx_;
   ev_signal sigintev_;
+  BenchStats bench_stats_;
+  // txbufs_ is the pool of the transmit buffers which are not used
+  // by any connection.
+  std::vector<std::unique_ptr<uint8_t[]>> txbufs_;
 };
 
 #endif // SERVER_H
@@ -25,6 +25,11 @@
  */
 #include "http.h"
 
+#include <cassert>
+#include <algorithm>
+
+#include "util.h"
+
 namespace ngtcp2 {
 
 namespace http {
@@ -104,6 +109,8 @@ std::string get_reason_phrase(unsigned int status_code) {
     return "Expectation Failed";
   case 421:
     return "Misdirected Request";
+  case 425:
+    return "Too Early";
   case 426:
     return "Upgrade Required";
   case 428:
@@ -133,6 +140,217 @@ std::string get_reason_phrase(unsigned int status_code) {
   }
 }
 
+bool is_safe_method(const std::string_view &method) {
+  return method == "GET" || method == "HEAD" || method == "OPTIONS" ||
+         method == "TRACE";
+}
+
+std::optional<ConnectUDPTarget>
+parse_connect_udp_path(const std::string_view &path) {
+  constexpr std::string_view prefix = "/.well-known/masque/udp/";
+
+  if (!path.starts_with(prefix)) {
+    return {};
+  }
+
+  auto rest = path.substr(prefix.size());
+
+  auto slash = rest.find('/');
+  if (slash == 0 || slash == std::string_view::npos) {
+    return {};
+  }
+
+  auto host = rest.substr(0, slash);
+  auto port = rest.substr(slash + 1);
+
+  if (port.empty() || port.back() != '/') {
+    return {};
+  }
+
+  port.remove_suffix(1);
+
+  if (port.empty() || port.size() > 5) {
+    return {};
+  }
+
+  for (auto c : port) {
+    if (c < '0' || '9' < c) {
+      return {};
+    }
+  }
+
+  return ConnectUDPTarget{
+      util::percent_decode(std::begin(host), std::end(host)),
+      std::string{port},
+  };
+}
+
+std::optional<ByteRange> parse_range(const std::string_view &value,
+                                     uint64_t length) {
+  constexpr std::string_view prefix = "bytes=";
+
+  if (!value.starts_with(prefix)) {
+    return {};
+  }
+
+  auto spec = value.substr(prefix.size());
+
+  auto dash = spec.find('-');
+  if (dash == std::string_view::npos || length == 0) {
+    return {};
+  }
+
+  auto first = spec.substr(0, dash);
+  auto last = spec.substr(dash + 1);
+
+  if (first.empty()) {
+    // suffix-range
+    auto n = util::parse_uint(last);
+    if (!n || *n == 0) {
+      return {};
+    }
+
+    return ByteRange{length - std::min(*n, length), length - 1};
+  }
+
+  auto f = util::parse_uint(first);
+  if (!f || *f >= length) {
+    return {};
+  }
+
+  if (last.empty()) {
+    return ByteRange{*f, length - 1};
+  }
+
+  auto l = util::parse_uint(last);
+  if (!l || *l < *f) {
+    return {};
+  }
+
+  return ByteRange{*f, std::min(*l, length - 1)};
+}
+
+std::optional<ContentRange>
+parse_content_range(const std::string_view &value) {
+  constexpr std::string_view prefix = "bytes ";
+
+  if (!value.starts_with(prefix)) {
+    return {};
+  }
+
+  auto spec = value.substr(prefix.size());
+
+  auto dash = spec.find('-');
+  auto slash = spec.find('/');
+  if (dash == std::string_view::npos || slash == std::string_view::npos ||
+      slash < dash) {
+    return {};
+  }
+
+  auto f = util::parse_uint(spec.substr(0, dash));
+  auto l = util::parse_uint(spec.substr(dash + 1, slash - dash - 1));
+  auto n = util::parse_uint(spec.substr(slash + 1));
+  if (!f || !l || !n || *l < *f || *l >= *n) {
+    return {};
+  }
+
+  return ContentRange{{*f, *l}, *n};
+}
+
+namespace {
+// get_varint decodes QUIC variable-length integer from [*pp, end),
+// and advances *pp past it.
+std::optional<uint64_t> get_varint(const uint8_t **pp, const uint8_t *end) {
+  auto p = *pp;
+
+  if (p == end) {
+    return {};
+  }
+
+  size_t len = 1u << (*p >> 6);
+
+  if (static_cast<size_t>(end - p) < len) {
+    return {};
+  }
+
+  uint64_t n = *p++ & 0x3f;
+
+  for (size_t i = 1; i < len; ++i) {
+    n = (n << 8) | *p++;
+  }
+
+  *pp = p;
+
+  return n;
+}
+} // namespace
+
+namespace {
+// put_varint encodes |n| as QUIC variable-length integer to |p|, and
+// returns the end of the written bytes.
+uint8_t *put_varint(uint8_t *p, uint64_t n) {
+  size_t len;
+  uint8_t prefix;
+
+  if (n < 64) {
+    len = 1;
+    prefix = 0;
+  } else if (n < 16384) {
+    len = 2;
+    prefix = 0x40;
+  } else if (n < 1073741824) {
+    len = 4;
+    prefix = 0x80;
+  } else {
+    assert(n < 4611686018427387904ull);
+    len = 8;
+    prefix = 0xc0;
+  }
+
+  for (size_t i = len; i > 0; --i) {
+    p[i - 1] = static_cast<uint8_t>(n);
+    n >>= 8;
+  }
+
+  p[0] |= prefix;
+
+  return p + len;
+}
+} // namespace
+
+std::optional<HTTPDatagram> decode_http_datagram(const uint8_t *data,
+                                                 size_t datalen) {
+  auto end = data + datalen;
+
+  auto quarter_stream_id = get_varint(&data, end);
+  if (!quarter_stream_id || *quarter_stream_id >= (1ull << 60)) {
+    return {};
+  }
+
+  auto context_id = get_varint(&data, end);
+  if (!context_id) {
+    return {};
+  }
+
+  return HTTPDatagram{
+      static_cast<int64_t>(*quarter_stream_id * 4),
+      *context_id,
+      data,
+      static_cast<size_t>(end - data),
+  };
+}
+
+size_t write_http_datagram_header(uint8_t *dest, int64_t stream_id,
+                                  uint64_t context_id) {
+  assert(stream_id >= 0);
+  assert((stream_id & 0x3) == 0);
+
+  auto p = put_varint(dest, static_cast<uint64_t>(stream_id) / 4);
+  p = put_varint(p, context_id);
+
+  return static_cast<size_t>(p - dest);
+}
+
 } // namespace http
 
 } // namespace ngtcp2
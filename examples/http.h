@@ -29,7 +29,10 @@
 #  include <config.h>
 #endif // HAVE_CONFIG_H
 
+#include <cstdint>
+#include <optional>
 #include <string>
+#include <string_view>
 
 namespace ngtcp2 {
 
@@ -37,6 +40,87 @@ namespace http {
 
 std::string get_reason_phrase(unsigned int status_code);
 
+// is_safe_method returns true if |method| is a safe method defined in
+// RFC 9110.  A request with a safe method does not change the state
+// of the server, so that it can be served from 0-RTT which an
+// attacker might replay.
+bool is_safe_method(const std::string_view &method);
+
+// ConnectUDPTarget is the target of CONNECT-UDP request defined in
+// RFC 9298.
+struct ConnectUDPTarget {
+  std::string host;
+  std::string port;
+};
+
+// parse_connect_udp_path parses |path| of CONNECT-UDP request which
+// follows the default URI template
+// "/.well-known/masque/udp/{target_host}/{target_port}/".  The
+// percent-encoded target_host, e.g., IPv6 address, is decoded.  It
+// returns std::nullopt if |path| does not match the template.
+std::optional<ConnectUDPTarget>
+parse_connect_udp_path(const std::string_view &path);
+
+// ByteRange is a range of bytes, [first, last], of a representation
+// defined in RFC 9110.
+struct ByteRange {
+  uint64_t first;
+  uint64_t last;
+};
+
+// parse_range parses |value| of range header field which specifies a
+// single range, e.g., "bytes=0-1023", "bytes=1024-", or "bytes=-512",
+// of the representation of length |length|.  The last byte position
+// is clamped to the end of the representation.  It returns
+// std::nullopt if |value| is malformed, specifies multiple ranges, or
+// is not satisfiable.
+std::optional<ByteRange> parse_range(const std::string_view &value,
+                                     uint64_t length);
+
+// ContentRange is the value of content-range header field of 206
+// response.
+struct ContentRange {
+  ByteRange range;
+  // length is the length of the whole representation.
+  uint64_t length;
+};
+
+// parse_content_range parses |value| of content-range header field,
+// e.g., "bytes 0-1023/4096".  It returns std::nullopt if |value| is
+// malformed, or the length of the representation is unknown.
+std::optional<ContentRange>
+parse_content_range(const std::string_view &value);
+
+// HTTPDatagram is HTTP Datagram defined in RFC 9297 which is carried
+// in QUIC DATAGRAM frame.
+struct HTTPDatagram {
+  // stream_id is the ID of the request stream which the datagram is
+  // associated with.
+  int64_t stream_id;
+  // context_id is the Context ID defined in RFC 9298.  0 indicates
+  // that the payload is UDP payload.
+  uint64_t context_id;
+  const uint8_t *payload;
+  size_t payloadlen;
+};
+
+// decode_http_datagram decodes |data| of length |datalen| as
+// HTTPDatagram which has Context ID.  payload points into |data|.  It
+// returns std::nullopt if |data| is malformed.
+std::optional<HTTPDatagram> decode_http_datagram(const uint8_t *data,
+                                                 size_t datalen);
+
+// HTTP_DATAGRAM_MAX_HEADERLEN is the maximum length of Quarter Stream
+// ID and Context ID which precede the payload of HTTPDatagram.
+constexpr size_t HTTP_DATAGRAM_MAX_HEADERLEN = 16;
+
+// write_http_datagram_header writes Quarter Stream ID derived from
+// |stream_id| and |context_id| to the buffer pointed by |dest|, and
+// returns the number of bytes written.  The buffer must have at least
+// HTTP_DATAGRAM_MAX_HEADERLEN bytes.
+size_t write_http_datagram_header(uint8_t *dest, int64_t stream_id,
+                                  uint64_t context_id);
+
 } // namespace http
 
 } // namespace ngtcp2
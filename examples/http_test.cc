@@ -0,0 +1,189 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "http_test.h"
+
+#include <algorithm>
+#include <array>
+
+#include <CUnit/CUnit.h>
+
+#include "http.h"
+
+namespace ngtcp2 {
+
+void test_http_is_safe_method() {
+  CU_ASSERT(http::is_safe_method("GET"));
+  CU_ASSERT(http::is_safe_method("HEAD"));
+  CU_ASSERT(http::is_safe_method("OPTIONS"));
+  CU_ASSERT(http::is_safe_method("TRACE"));
+  CU_ASSERT(!http::is_safe_method("POST"));
+  CU_ASSERT(!http::is_safe_method("PUT"));
+  CU_ASSERT(!http::is_safe_method("DELETE"));
+  CU_ASSERT(!http::is_safe_method("CONNECT"));
+  // Method is case-sensitive.
+  CU_ASSERT(!http::is_safe_method("get"));
+  CU_ASSERT(!http::is_safe_method(""));
+}
+
+void test_http_parse_connect_udp_path() {
+  {
+    auto t = http::parse_connect_udp_path(
+        "/.well-known/masque/udp/192.0.2.6/443/");
+
+    CU_ASSERT(t.has_value());
+    CU_ASSERT("192.0.2.6" == t->host);
+    CU_ASSERT("443" == t->port);
+  }
+  {
+    auto t = http::parse_connect_udp_path(
+        "/.well-known/masque/udp/2001%3Adb8%3A%3A42/53/");
+
+    CU_ASSERT(t.has_value());
+    CU_ASSERT("2001:db8::42" == t->host);
+    CU_ASSERT("53" == t->port);
+  }
+  CU_ASSERT(!http::parse_connect_udp_path("/.well-known/masque/udp/"));
+  CU_ASSERT(
+      !http::parse_connect_udp_path("/.well-known/masque/udp/example.com/"));
+  CU_ASSERT(!http::parse_connect_udp_path(
+      "/.well-known/masque/udp/example.com/443"));
+  CU_ASSERT(!http::parse_connect_udp_path(
+      "/.well-known/masque/udp/example.com/https/"));
+  CU_ASSERT(!http::parse_connect_udp_path(
+      "/.well-known/masque/udp/example.com/443443/"));
+  CU_ASSERT(!http::parse_connect_udp_path(
+      "/.well-known/masque/udp//443/"));
+  CU_ASSERT(!http::parse_connect_udp_path("/index.html"));
+}
+
+void test_http_parse_range() {
+  {
+    auto r = http::parse_range("bytes=0-1023", 4096);
+
+    CU_ASSERT(r.has_value());
+    CU_ASSERT(0 == r->first);
+    CU_ASSERT(1023 == r->last);
+  }
+  {
+    auto r = http::parse_range("bytes=1024-", 4096);
+
+    CU_ASSERT(r.has_value());
+    CU_ASSERT(1024 == r->first);
+    CU_ASSERT(4095 == r->last);
+  }
+  {
+    auto r = http::parse_range("bytes=4000-8191", 4096);
+
+    CU_ASSERT(r.has_value());
+    CU_ASSERT(4000 == r->first);
+    CU_ASSERT(4095 == r->last);
+  }
+  {
+    auto r = http::parse_range("bytes=-512", 4096);
+
+    CU_ASSERT(r.has_value());
+    CU_ASSERT(3584 == r->first);
+    CU_ASSERT(4095 == r->last);
+  }
+  {
+    auto r = http::parse_range("bytes=-8192", 4096);
+
+    CU_ASSERT(r.has_value());
+    CU_ASSERT(0 == r->first);
+    CU_ASSERT(4095 == r->last);
+  }
+  CU_ASSERT(!http::parse_range("bytes=4096-", 4096));
+  CU_ASSERT(!http::parse_range("bytes=0-0", 0));
+  CU_ASSERT(!http::parse_range("bytes=-0", 4096));
+  CU_ASSERT(!http::parse_range("bytes=10-9", 4096));
+  CU_ASSERT(!http::parse_range("bytes=0-1,5-6", 4096));
+  CU_ASSERT(!http::parse_range("bytes=-", 4096));
+  CU_ASSERT(!http::parse_range("items=0-1", 4096));
+}
+
+void test_http_parse_content_range() {
+  {
+    auto r = http::parse_content_range("bytes 1024-2047/4096");
+
+    CU_ASSERT(r.has_value());
+    CU_ASSERT(1024 == r->range.first);
+    CU_ASSERT(2047 == r->range.last);
+    CU_ASSERT(4096 == r->length);
+  }
+  CU_ASSERT(!http::parse_content_range("bytes 0-1023/*"));
+  CU_ASSERT(!http::parse_content_range("bytes */4096"));
+  CU_ASSERT(!http::parse_content_range("bytes 0-4096/4096"));
+  CU_ASSERT(!http::parse_content_range("bytes 10-9/4096"));
+  CU_ASSERT(!http::parse_content_range("bytes=0-1023/4096"));
+}
+
+void test_http_datagram() {
+  std::array<uint8_t, http::HTTP_DATAGRAM_MAX_HEADERLEN + 4> buf;
+
+  {
+    auto n = http::write_http_datagram_header(buf.data(), 4, 0);
+
+    CU_ASSERT(2 == n);
+
+    std::copy_n("abcd", 4, buf.data() + n);
+
+    auto dgram = http::decode_http_datagram(buf.data(), n + 4);
+
+    CU_ASSERT(dgram.has_value());
+    CU_ASSERT(4 == dgram->stream_id);
+    CU_ASSERT(0 == dgram->context_id);
+    CU_ASSERT(buf.data() + n == dgram->payload);
+    CU_ASSERT(4 == dgram->payloadlen);
+  }
+  {
+    // Quarter Stream ID which takes 2 bytes, and an empty payload.
+    auto n = http::write_http_datagram_header(buf.data(), 256, 1000000);
+
+    CU_ASSERT(2 + 4 == n);
+
+    auto dgram = http::decode_http_datagram(buf.data(), n);
+
+    CU_ASSERT(dgram.has_value());
+    CU_ASSERT(256 == dgram->stream_id);
+    CU_ASSERT(1000000 == dgram->context_id);
+    CU_ASSERT(0 == dgram->payloadlen);
+  }
+  {
+    // Context ID is missing.
+    buf[0] = 0x01;
+
+    CU_ASSERT(!http::decode_http_datagram(buf.data(), 1));
+  }
+  {
+    // Context ID is truncated.
+    buf[0] = 0x01;
+    buf[1] = 0x80;
+
+    CU_ASSERT(!http::decode_http_datagram(buf.data(), 2));
+  }
+  CU_ASSERT(!http::decode_http_datagram(buf.data(), 0));
+}
+
+} // namespace ngtcp2
@@ -0,0 +1,139 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <cstdint>
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <vector>
+
+// LatencyHistogram is a log-linear histogram in the spirit of HDR
+// Histogram.  A value below 2 * SUB_BUCKET_COUNT is counted exactly.
+// A larger value v falls in a bucket whose width is less than
+// v / SUB_BUCKET_COUNT, so that a percentile is reported within 0.8%
+// relative error over the whole range of uint64_t with a fixed
+// number of counters.  The latencies are recorded in nanoseconds.
+class LatencyHistogram {
+public:
+  static constexpr size_t SUB_BUCKET_BITS = 7;
+  static constexpr size_t SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+  static constexpr size_t NBUCKET =
+      (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+  LatencyHistogram()
+      : counts_(NBUCKET),
+        count_(0),
+        sum_(0),
+        min_(std::numeric_limits<uint64_t>::max()),
+        max_(0) {}
+
+  void record(uint64_t v) {
+    ++counts_[bucket_index(v)];
+    ++count_;
+    sum_ += v;
+    min_ = std::min(min_, v);
+    max_ = std::max(max_, v);
+  }
+
+  // merge adds all values recorded in |other| to this histogram.
+  void merge(const LatencyHistogram &other) {
+    for (size_t i = 0; i < NBUCKET; ++i) {
+      counts_[i] += other.counts_[i];
+    }
+
+    count_ += other.count_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+  }
+
+  uint64_t count() const { return count_; }
+  uint64_t min() const { return count_ ? min_ : 0; }
+  uint64_t max() const { return max_; }
+  uint64_t mean() const { return count_ ? sum_ / count_ : 0; }
+
+  // percentile returns the value below which |p| percent of the
+  // recorded values fall.  It returns the largest value of the bucket
+  // which contains the value, but never more than max().
+  uint64_t percentile(double p) const {
+    if (count_ == 0) {
+      return 0;
+    }
+
+    auto target = static_cast<uint64_t>(p / 100 * static_cast<double>(count_));
+    target = std::clamp(target, uint64_t{1}, count_);
+
+    uint64_t n = 0;
+
+    for (size_t i = 0; i < NBUCKET; ++i) {
+      n += counts_[i];
+      if (n >= target) {
+        return std::min(bucket_max(i), max_);
+      }
+    }
+
+    return max_;
+  }
+
+  // bucket_index returns the index of the bucket which |v| falls in.
+  static size_t bucket_index(uint64_t v) {
+    if (v < 2 * SUB_BUCKET_COUNT) {
+      return static_cast<size_t>(v);
+    }
+
+    // v >> shift is in [SUB_BUCKET_COUNT, 2 * SUB_BUCKET_COUNT).
+    auto shift = static_cast<size_t>(std::bit_width(v)) - SUB_BUCKET_BITS - 1;
+
+    return shift * SUB_BUCKET_COUNT + static_cast<size_t>(v >> shift);
+  }
+
+  // bucket_max returns the largest value which falls in the bucket at
+  // |idx|.
+  static uint64_t bucket_max(size_t idx) {
+    if (idx < 2 * SUB_BUCKET_COUNT) {
+      return idx;
+    }
+
+    auto shift = idx / SUB_BUCKET_COUNT - 1;
+    uint64_t sub = idx - shift * SUB_BUCKET_COUNT;
+
+    return ((sub + 1) << shift) - 1;
+  }
+
+private:
+  std::vector<uint64_t> counts_;
+  uint64_t count_;
+  uint64_t sum_;
+  uint64_t min_;
+  uint64_t max_;
+};
+
+#endif // LATENCY_HISTOGRAM_H
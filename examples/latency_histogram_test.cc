@@ -0,0 +1,111 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "latency_histogram_test.h"
+
+#include <limits>
+
+#include <CUnit/CUnit.h>
+
+#include "latency_histogram.h"
+
+namespace ngtcp2 {
+
+void test_latency_histogram_bucket() {
+  using H = LatencyHistogram;
+
+  // Small values are counted exactly.
+  CU_ASSERT(0 == H::bucket_index(0));
+  CU_ASSERT(255 == H::bucket_index(255));
+  CU_ASSERT(255 == H::bucket_max(255));
+
+  // The first bucket of width 2.
+  CU_ASSERT(256 == H::bucket_index(256));
+  CU_ASSERT(256 == H::bucket_index(257));
+  CU_ASSERT(257 == H::bucket_max(256));
+  CU_ASSERT(257 == H::bucket_index(258));
+
+  CU_ASSERT(H::NBUCKET - 1 ==
+            H::bucket_index(std::numeric_limits<uint64_t>::max()));
+  CU_ASSERT(std::numeric_limits<uint64_t>::max() ==
+            H::bucket_max(H::NBUCKET - 1));
+
+  // Buckets are contiguous, and their width is less than 1/128 of
+  // their values.
+  for (size_t i = 1; i < H::NBUCKET; ++i) {
+    auto lo = H::bucket_max(i - 1) + 1;
+    auto hi = H::bucket_max(i);
+
+    CU_ASSERT(i == H::bucket_index(lo));
+    CU_ASSERT(i == H::bucket_index(hi));
+    CU_ASSERT((hi - lo) / H::SUB_BUCKET_COUNT < lo / H::SUB_BUCKET_COUNT ||
+              hi - lo == 0);
+  }
+}
+
+void test_latency_histogram_percentile() {
+  LatencyHistogram h;
+
+  CU_ASSERT(0 == h.count());
+  CU_ASSERT(0 == h.min());
+  CU_ASSERT(0 == h.max());
+  CU_ASSERT(0 == h.percentile(50));
+
+  // 1us, 2us, ..., 10000us.
+  for (uint64_t i = 1; i <= 10000; ++i) {
+    h.record(i * 1000);
+  }
+
+  CU_ASSERT(10000 == h.count());
+  CU_ASSERT(1000 == h.min());
+  CU_ASSERT(10000000 == h.max());
+  CU_ASSERT(5000500 == h.mean());
+
+  auto p50 = h.percentile(50);
+
+  CU_ASSERT(p50 >= 5000000);
+  CU_ASSERT(p50 < 5000000 + 5000000 / 128);
+
+  auto p99 = h.percentile(99);
+
+  CU_ASSERT(p99 >= 9900000);
+  CU_ASSERT(p99 < 9900000 + 9900000 / 128);
+
+  CU_ASSERT(10000000 == h.percentile(100));
+  CU_ASSERT(h.percentile(0) < 1000 + 1000 / 128);
+
+  LatencyHistogram h2;
+
+  h2.record(1);
+  h2.record(20000000);
+
+  h.merge(h2);
+
+  CU_ASSERT(10002 == h.count());
+  CU_ASSERT(1 == h.min());
+  CU_ASSERT(20000000 == h.max());
+  CU_ASSERT(20000000 == h.percentile(100));
+}
+
+} // namespace ngtcp2
@@ -0,0 +1,362 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <ngtcp2/ngtcp2.h>
+
+// Counter is a monotonically increasing counter.  It is updated only
+// by the worker thread which owns it, and read by the metrics
+// endpoint from the other thread.  Because there is a single writer,
+// it is updated with a plain load and store instead of a locked
+// read-modify-write.
+class Counter {
+public:
+  Counter() : v_(0) {}
+
+  void add(uint64_t n = 1) {
+    v_.store(v_.load(std::memory_order_relaxed) + n,
+             std::memory_order_relaxed);
+  }
+
+  uint64_t value() const { return v_.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint64_t> v_;
+};
+
+// Gauge is a value which goes up and down.  Like Counter, it has a
+// single writer.
+class Gauge {
+public:
+  Gauge() : v_(0) {}
+
+  void add(int64_t n) {
+    v_.store(v_.load(std::memory_order_relaxed) + n,
+             std::memory_order_relaxed);
+  }
+
+  int64_t value() const { return v_.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<int64_t> v_;
+};
+
+// Histogram counts observed values in buckets whose inclusive upper
+// bounds are |bounds| in ascending order.  The last bucket, which
+// has no upper bound, is implicit.  It has a single writer.
+class Histogram {
+public:
+  explicit Histogram(std::vector<uint64_t> bounds)
+      : bounds_(std::move(bounds)), counts_(bounds_.size() + 1) {}
+
+  void observe(uint64_t v) {
+    size_t i = 0;
+
+    for (; i < bounds_.size() && v > bounds_[i]; ++i)
+      ;
+
+    counts_[i].add();
+    sum_.add(v);
+  }
+
+  const std::vector<uint64_t> &bounds() const { return bounds_; }
+  // bucket_count returns the number of values in the bucket at |i|.
+  // The bucket at bounds().size() has no upper bound.
+  uint64_t bucket_count(size_t i) const { return counts_[i].value(); }
+  uint64_t sum() const { return sum_.value(); }
+
+private:
+  std::vector<uint64_t> bounds_;
+  std::vector<Counter> counts_;
+  Counter sum_;
+};
+
+// exponential_bounds returns |n| bucket bounds which start at |start|
+// and grow by |factor|.
+inline std::vector<uint64_t> exponential_bounds(uint64_t start,
+                                                uint64_t factor, size_t n) {
+  std::vector<uint64_t> bounds;
+
+  bounds.reserve(n);
+
+  for (size_t i = 0; i < n; ++i, start *= factor) {
+    bounds.push_back(start);
+  }
+
+  return bounds;
+}
+
+// WorkerMetrics is the metrics of a single worker.  The per-connection
+// fields are taken from ngtcp2_conn_stat and ngtcp2_stall_stat when a
+// connection is closed.
+struct WorkerMetrics {
+  explicit WorkerMetrics(size_t worker_id)
+      : worker_id(worker_id),
+        gso_batch(exponential_bounds(1, 2, 7)),
+        handshake_latency(exponential_bounds(250 * NGTCP2_MICROSECONDS, 2, 16)),
+        cwnd(exponential_bounds(4096, 2, 16)) {}
+
+  // on_rx counts UDP datagrams of length |datalen| in total which
+  // are received at once.  Each of them is |gso_size| bytes long
+  // except for the last one.
+  void on_rx(size_t datalen, size_t gso_size) {
+    if (datalen == 0) {
+      return;
+    }
+
+    rx_pkts.add((datalen + gso_size - 1) / gso_size);
+    rx_bytes.add(datalen);
+  }
+
+  // on_tx counts UDP datagrams which are handed to the socket in a
+  // single GSO batch.
+  void on_tx(size_t datalen, size_t gso_size) {
+    auto n = (datalen + gso_size - 1) / gso_size;
+
+    tx_pkts.add(n);
+    tx_bytes.add(datalen);
+    gso_batch.observe(n);
+  }
+
+  // on_conn_close records the statistics of a connection which is
+  // being closed.
+  void on_conn_close(const ngtcp2_conn_stat &cstat,
+                     const ngtcp2_stall_stat &sstat) {
+    lost_pkts.add(cstat.lost_pkt_count);
+    decrypt_failures.add(cstat.decrypt_failure_count);
+    cwnd.observe(cstat.cwnd);
+    stall_cwnd.add(sstat.cwnd);
+    stall_pacing.add(sstat.pacing);
+    stall_conn_flow_control.add(sstat.conn_flow_control);
+    stall_stream_flow_control.add(sstat.stream_flow_control);
+    stall_app.add(sstat.app);
+  }
+
+  size_t worker_id;
+  // rx_pkts and rx_bytes are the number of UDP datagrams and bytes
+  // received.
+  Counter rx_pkts;
+  Counter rx_bytes;
+  // rx_kernel_drops is the number of UDP datagrams that the kernel
+  // dropped because the socket receive buffer was full.  Unlike
+  // lost_pkts, they never made it to the server.
+  Counter rx_kernel_drops;
+  // tx_pkts and tx_bytes are the number of UDP datagrams and bytes
+  // sent.
+  Counter tx_pkts;
+  Counter tx_bytes;
+  // lost_pkts is the number of packets declared lost.  lost_pkts /
+  // tx_pkts approximates the retransmission rate.
+  Counter lost_pkts;
+  // decrypt_failures is the number of packets which could not be
+  // decrypted.
+  Counter decrypt_failures;
+  // handshakes is the number of completed handshakes.
+  Counter handshakes;
+  // connections is the number of connections currently open.
+  Gauge connections;
+  // sock_buf_bytes is the current size of the socket buffers.
+  Gauge sock_buf_bytes;
+  // stall_* are the time in nanoseconds during which connections
+  // could not send packets, per reason.
+  Counter stall_cwnd;
+  Counter stall_pacing;
+  Counter stall_conn_flow_control;
+  Counter stall_stream_flow_control;
+  Counter stall_app;
+  // gso_batch is the number of UDP datagrams in a GSO batch.
+  Histogram gso_batch;
+  // handshake_latency is the time in nanoseconds from the first
+  // packet of a connection until its handshake completes.
+  Histogram handshake_latency;
+  // cwnd is the congestion window of connections when they are
+  // closed.
+  Histogram cwnd;
+};
+
+// MetricsRegistry holds WorkerMetrics of all workers, and formats
+// them in Prometheus text exposition format.
+class MetricsRegistry {
+public:
+  // add_worker creates WorkerMetrics for the worker |worker_id|.  It
+  // is owned by this object.
+  WorkerMetrics &add_worker(size_t worker_id) {
+    std::lock_guard<std::mutex> lg(mu_);
+
+    workers_.push_back(std::make_unique<WorkerMetrics>(worker_id));
+
+    return *workers_.back();
+  }
+
+  // format returns the metrics of all workers in Prometheus text
+  // exposition format.  Each sample is labeled with the worker ID.
+  std::string format() const {
+    std::lock_guard<std::mutex> lg(mu_);
+    std::ostringstream os;
+
+    write_counter(os, "ngtcp2_server_rx_packets_total",
+                  "Number of UDP datagrams received.",
+                  [](const WorkerMetrics &m) { return m.rx_pkts.value(); });
+    write_counter(os, "ngtcp2_server_rx_bytes_total",
+                  "Number of bytes received.",
+                  [](const WorkerMetrics &m) { return m.rx_bytes.value(); });
+    write_counter(
+        os, "ngtcp2_server_rx_kernel_drops_total",
+        "Number of UDP datagrams dropped by the kernel because the socket "
+        "receive buffer was full.",
+        [](const WorkerMetrics &m) { return m.rx_kernel_drops.value(); });
+    write_counter(os, "ngtcp2_server_tx_packets_total",
+                  "Number of UDP datagrams sent.",
+                  [](const WorkerMetrics &m) { return m.tx_pkts.value(); });
+    write_counter(os, "ngtcp2_server_tx_bytes_total", "Number of bytes sent.",
+                  [](const WorkerMetrics &m) { return m.tx_bytes.value(); });
+    write_counter(
+        os, "ngtcp2_server_lost_packets_total",
+        "Number of packets declared lost by closed connections.",
+        [](const WorkerMetrics &m) { return m.lost_pkts.value(); });
+    write_counter(
+        os, "ngtcp2_server_decrypt_failures_total",
+        "Number of packets which closed connections could not decrypt.",
+        [](const WorkerMetrics &m) { return m.decrypt_failures.value(); });
+    write_counter(os, "ngtcp2_server_handshakes_total",
+                  "Number of completed handshakes.",
+                  [](const WorkerMetrics &m) { return m.handshakes.value(); });
+
+    os << "# HELP ngtcp2_server_connections Number of open connections.\n"
+          "# TYPE ngtcp2_server_connections gauge\n";
+    for (auto &m : workers_) {
+      os << "ngtcp2_server_connections{worker=\"" << m->worker_id << "\"} "
+         << m->connections.value() << '\n';
+    }
+
+    os << "# HELP ngtcp2_server_socket_buffer_bytes Size of the socket "
+          "buffers.\n"
+          "# TYPE ngtcp2_server_socket_buffer_bytes gauge\n";
+    for (auto &m : workers_) {
+      os << "ngtcp2_server_socket_buffer_bytes{worker=\"" << m->worker_id
+         << "\"} " << m->sock_buf_bytes.value() << '\n';
+    }
+
+    os << "# HELP ngtcp2_server_stall_seconds_total Time during which closed "
+          "connections could not send packets.\n"
+          "# TYPE ngtcp2_server_stall_seconds_total counter\n";
+    for (auto &m : workers_) {
+      std::array<std::pair<std::string_view, const Counter *>, 5> stalls{{
+          {"cwnd", &m->stall_cwnd},
+          {"pacing", &m->stall_pacing},
+          {"conn_flow_control", &m->stall_conn_flow_control},
+          {"stream_flow_control", &m->stall_stream_flow_control},
+          {"app", &m->stall_app},
+      }};
+
+      for (auto &[reason, c] : stalls) {
+        os << "ngtcp2_server_stall_seconds_total{worker=\"" << m->worker_id
+           << "\",reason=\"" << reason << "\"} "
+           << static_cast<double>(c->value()) / NGTCP2_SECONDS << '\n';
+      }
+    }
+
+    write_histogram(os, "ngtcp2_server_gso_batch_packets",
+                    "Number of UDP datagrams in a GSO batch.", 1,
+                    [](const WorkerMetrics &m) -> auto & {
+                      return m.gso_batch;
+                    });
+    write_histogram(os, "ngtcp2_server_handshake_seconds",
+                    "Time from the first packet until the handshake "
+                    "completes.",
+                    NGTCP2_SECONDS,
+                    [](const WorkerMetrics &m) -> auto & {
+                      return m.handshake_latency;
+                    });
+    write_histogram(os, "ngtcp2_server_cwnd_bytes",
+                    "Congestion window of connections when they are "
+                    "closed.",
+                    1, [](const WorkerMetrics &m) -> auto & { return m.cwnd; });
+
+    return os.str();
+  }
+
+private:
+  template <typename F>
+  void write_counter(std::ostringstream &os, std::string_view name,
+                     std::string_view help, F get) const {
+    os << "# HELP " << name << ' ' << help << "\n# TYPE " << name
+       << " counter\n";
+
+    for (auto &m : workers_) {
+      os << name << "{worker=\"" << m->worker_id << "\"} " << get(*m) << '\n';
+    }
+  }
+
+  // write_histogram writes histograms of all workers.  The values are
+  // divided by |unit|.
+  template <typename F>
+  void write_histogram(std::ostringstream &os, std::string_view name,
+                       std::string_view help, uint64_t unit, F get) const {
+    os << "# HELP " << name << ' ' << help << "\n# TYPE " << name
+       << " histogram\n";
+
+    for (auto &m : workers_) {
+      const Histogram &h = get(*m);
+      auto &bounds = h.bounds();
+      uint64_t n = 0;
+
+      for (size_t i = 0; i < bounds.size(); ++i) {
+        n += h.bucket_count(i);
+        os << name << "_bucket{worker=\"" << m->worker_id << "\",le=\""
+           << static_cast<double>(bounds[i]) / static_cast<double>(unit)
+           << "\"} " << n << '\n';
+      }
+
+      n += h.bucket_count(bounds.size());
+
+      os << name << "_bucket{worker=\"" << m->worker_id << "\",le=\"+Inf\"} "
+         << n << '\n'
+         << name << "_sum{worker=\"" << m->worker_id << "\"} "
+         << static_cast<double>(h.sum()) / static_cast<double>(unit) << '\n'
+         << name << "_count{worker=\"" << m->worker_id << "\"} " << n << '\n';
+    }
+  }
+
+  mutable std::mutex mu_;
+  std::vector<std::unique_ptr<WorkerMetrics>> workers_;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,102 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "metrics_test.h"
+
+#include <CUnit/CUnit.h>
+
+#include "metrics.h"
+
+namespace ngtcp2 {
+
+void test_metrics_histogram() {
+  Histogram h(exponential_bounds(1, 2, 4));
+
+  CU_ASSERT((std::vector<uint64_t>{1, 2, 4, 8} == h.bounds()));
+
+  h.observe(0);
+  h.observe(1);
+  h.observe(3);
+  h.observe(8);
+  h.observe(9);
+
+  CU_ASSERT(2 == h.bucket_count(0));
+  CU_ASSERT(0 == h.bucket_count(1));
+  CU_ASSERT(1 == h.bucket_count(2));
+  CU_ASSERT(1 == h.bucket_count(3));
+  CU_ASSERT(1 == h.bucket_count(4));
+  CU_ASSERT(21 == h.sum());
+}
+
+void test_metrics_format() {
+  MetricsRegistry reg;
+  auto &m0 = reg.add_worker(0);
+  auto &m1 = reg.add_worker(1);
+
+  // 3 datagrams coalesced by UDP_GRO.
+  m0.on_rx(2500, 1000);
+  m0.on_tx(1200, 1200);
+  m0.on_tx(3000, 1200);
+  m1.handshakes.add(2);
+  m1.rx_kernel_drops.add(7);
+  m1.sock_buf_bytes.add(1048576);
+  m1.handshake_latency.observe(NGTCP2_SECONDS / 1000);
+
+  auto s = reg.format();
+
+  CU_ASSERT(std::string::npos !=
+            s.find("# TYPE ngtcp2_server_rx_packets_total counter\n"));
+  CU_ASSERT(std::string::npos !=
+            s.find("ngtcp2_server_rx_packets_total{worker=\"0\"} 3\n"));
+  CU_ASSERT(std::string::npos !=
+            s.find("ngtcp2_server_rx_bytes_total{worker=\"0\"} 2500\n"));
+  CU_ASSERT(std::string::npos !=
+            s.find("ngtcp2_server_tx_packets_total{worker=\"0\"} 4\n"));
+  CU_ASSERT(std::string::npos !=
+            s.find("ngtcp2_server_handshakes_total{worker=\"1\"} 2\n"));
+  CU_ASSERT(std::string::npos !=
+            s.find("ngtcp2_server_rx_kernel_drops_total{worker=\"1\"} 7\n"));
+  CU_ASSERT(std::string::npos !=
+            s.find("ngtcp2_server_socket_buffer_bytes{worker=\"1\"} "
+                   "1048576\n"));
+  CU_ASSERT(std::string::npos !=
+            s.find("ngtcp2_server_gso_batch_packets_bucket{worker=\"0\","
+                   "le=\"1\"} 1\n"));
+  CU_ASSERT(std::string::npos !=
+            s.find("ngtcp2_server_gso_batch_packets_bucket{worker=\"0\","
+                   "le=\"4\"} 2\n"));
+  CU_ASSERT(std::string::npos !=
+            s.find("ngtcp2_server_gso_batch_packets_count{worker=\"0\"} 2\n"));
+  CU_ASSERT(std::string::npos !=
+            s.find("ngtcp2_server_handshake_seconds_bucket{worker=\"1\","
+                   "le=\"0.001\"} 1\n"));
+  CU_ASSERT(std::string::npos !=
+            s.find("ngtcp2_server_handshake_seconds_bucket{worker=\"1\","
+                   "le=\"0.0005\"} 0\n"));
+  CU_ASSERT(std::string::npos !=
+            s.find("ngtcp2_server_handshake_seconds_sum{worker=\"1\"} "
+                   "0.001\n"));
+}
+
+} // namespace ngtcp2
@@ -0,0 +1,204 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "netem.h"
+
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "util.h"
+
+namespace ngtcp2 {
+
+namespace {
+// parse_prob parses |s| as a probability in [0, 1].
+std::optional<double> parse_prob(const std::string_view &s) {
+  if (s.empty()) {
+    return {};
+  }
+
+  auto str = std::string{s};
+  char *end;
+  errno = 0;
+  auto p = strtod(str.c_str(), &end);
+  if (errno != 0 || end != str.c_str() + str.size() || !(p >= 0 && p <= 1)) {
+    return {};
+  }
+
+  return p;
+}
+} // namespace
+
+std::optional<NetEmConfig> parse_netem_config(const std::string_view &s) {
+  NetEmConfig config{
+      .ge_loss_bad = 1.,
+  };
+
+  for (auto &kv : util::split_str(s)) {
+    auto pos = kv.find('=');
+    if (pos == std::string_view::npos) {
+      return {};
+    }
+
+    auto key = kv.substr(0, pos);
+    auto value = kv.substr(pos + 1);
+
+    if (key == "delay" || key == "jitter") {
+      auto d = util::parse_duration(value);
+      if (!d) {
+        return {};
+      }
+      (key == "delay" ? config.delay : config.jitter) = *d;
+    } else if (key == "rate" || key == "limit") {
+      auto n = util::parse_uint_iec(value);
+      if (!n) {
+        return {};
+      }
+      (key == "rate" ? config.rate : config.limit) = *n;
+    } else if (key == "loss" || key == "reorder") {
+      auto p = parse_prob(value);
+      if (!p) {
+        return {};
+      }
+      (key == "loss" ? config.loss : config.reorder) = *p;
+    } else if (key == "ge") {
+      auto params = util::split_str(value, '/');
+      if (params.size() < 2 || params.size() > 4) {
+        return {};
+      }
+
+      std::array<double *, 4> dest{&config.ge_p, &config.ge_r,
+                                   &config.ge_loss_bad, &config.ge_loss_good};
+
+      for (size_t i = 0; i < params.size(); ++i) {
+        auto p = parse_prob(params[i]);
+        if (!p) {
+          return {};
+        }
+        *dest[i] = *p;
+      }
+
+      config.gilbert_elliott = true;
+    } else if (key == "seed") {
+      auto n = util::parse_uint(value);
+      if (!n) {
+        return {};
+      }
+      config.seed = *n;
+    } else {
+      return {};
+    }
+  }
+
+  if (config.jitter > config.delay) {
+    return {};
+  }
+
+  return config;
+}
+
+NetEm::NetEm(const NetEmConfig &config)
+    : config_(config),
+      randgen_(config.seed),
+      link_ts_(0),
+      seq_(0),
+      nlost_(0),
+      ndropped_(0),
+      ge_bad_(false) {}
+
+bool NetEm::lose() {
+  if (!config_.gilbert_elliott) {
+    return config_.loss > 0 && uniform() < config_.loss;
+  }
+
+  if (ge_bad_) {
+    if (uniform() < config_.ge_r) {
+      ge_bad_ = false;
+    }
+  } else if (uniform() < config_.ge_p) {
+    ge_bad_ = true;
+  }
+
+  return uniform() < (ge_bad_ ? config_.ge_loss_bad : config_.ge_loss_good);
+}
+
+bool NetEm::send(void *user_data, const ngtcp2_addr &local_addr,
+                 const ngtcp2_addr &remote_addr, unsigned int ecn,
+                 const uint8_t *data, size_t datalen, ngtcp2_tstamp ts) {
+  auto start_ts = std::max(link_ts_, ts);
+
+  if (config_.rate && config_.limit) {
+    // The number of bytes which have not been serialized yet.
+    auto backlog = (start_ts - ts) * config_.rate / NGTCP2_SECONDS;
+    if (backlog + datalen > config_.limit) {
+      ++ndropped_;
+      return false;
+    }
+  }
+
+  if (config_.rate) {
+    link_ts_ = start_ts + datalen * NGTCP2_SECONDS / config_.rate;
+  } else {
+    link_ts_ = start_ts;
+  }
+
+  // A lost packet still occupies the link.
+  if (lose()) {
+    ++nlost_;
+    return false;
+  }
+
+  auto pkt = std::make_unique<NetEmPacket>();
+
+  pkt->ts = link_ts_;
+
+  if (config_.reorder == 0 || uniform() >= config_.reorder) {
+    pkt->ts += config_.delay;
+
+    if (config_.jitter) {
+      pkt->ts -= config_.jitter;
+      pkt->ts += std::uniform_int_distribution<uint64_t>(
+          0, 2 * config_.jitter)(randgen_);
+    }
+  }
+
+  pkt->seq = seq_++;
+  pkt->user_data = user_data;
+  memcpy(&pkt->local_addr.su, local_addr.addr, local_addr.addrlen);
+  pkt->local_addr.len = local_addr.addrlen;
+  memcpy(&pkt->remote_addr.su, remote_addr.addr, remote_addr.addrlen);
+  pkt->remote_addr.len = remote_addr.addrlen;
+  pkt->ecn = ecn;
+  pkt->data.assign(data, data + datalen);
+
+  pq_.push_back(std::move(pkt));
+  std::push_heap(std::begin(pq_), std::end(pq_), greater);
+
+  return true;
+}
+
+} // namespace ngtcp2
@@ -0,0 +1,178 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NETEM_H
+#define NETEM_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <cstdint>
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string_view>
+#include <vector>
+
+#include <ngtcp2/ngtcp2.h>
+
+#include "network.h"
+
+namespace ngtcp2 {
+
+// NetEmConfig is the configuration of NetEm.
+struct NetEmConfig {
+  // delay is the one-way delay added to each packet.
+  ngtcp2_duration delay;
+  // jitter is the maximum deviation from delay.  The delay of each
+  // packet is chosen uniformly from [delay - jitter, delay + jitter],
+  // so a large jitter reorders packets.
+  ngtcp2_duration jitter;
+  // rate is the bandwidth of the link in bytes per second.  0 means
+  // unlimited.
+  uint64_t rate;
+  // limit is the maximum number of bytes which wait for the link to
+  // become free.  A packet which would exceed it is dropped at the
+  // tail.  0 means unlimited.
+  uint64_t limit;
+  // loss is the probability that a packet is lost.  It is used
+  // unless gilbert_elliott is true.
+  double loss;
+  // gilbert_elliott is true if the loss follows Gilbert-Elliott
+  // model.  The link moves from the good state to the bad state with
+  // probability ge_p, and from the bad state to the good state with
+  // probability ge_r for each packet.  A packet is lost with
+  // probability ge_loss_good in the good state, and ge_loss_bad in
+  // the bad state.
+  bool gilbert_elliott;
+  double ge_p;
+  double ge_r;
+  double ge_loss_good;
+  double ge_loss_bad;
+  // reorder is the probability that a packet skips the delay, and
+  // overtakes the packets which have been sent before it.
+  double reorder;
+  // seed is the seed of the random number generator.
+  uint64_t seed;
+};
+
+// parse_netem_config parses |s| which is a comma separated list of
+// key=value pairs:
+//
+//   delay=<DURATION>, jitter=<DURATION>, rate=<SIZE>, limit=<SIZE>,
+//   loss=<P>, ge=<P>/<R>[/<LOSS_BAD>[/<LOSS_GOOD>]], reorder=<P>,
+//   seed=<N>
+//
+// rate is in bytes per second.  It returns std::nullopt if |s| is
+// malformed.
+std::optional<NetEmConfig> parse_netem_config(const std::string_view &s);
+
+// NetEmPacket is a packet in NetEm.
+struct NetEmPacket {
+  // ts is the time when the packet leaves the emulated link.
+  ngtcp2_tstamp ts;
+  // seq keeps the packets which leave at the same time in order.
+  uint64_t seq;
+  // user_data is the opaque pointer passed to NetEm::send, which
+  // typically points to the endpoint to send the packet from.
+  void *user_data;
+  Address local_addr;
+  Address remote_addr;
+  unsigned int ecn;
+  std::vector<uint8_t> data;
+};
+
+// NetEm emulates a network link in user space, so that the
+// congestion controllers and loss recovery can be tried out without
+// root privileges, netem, or virtual machines.  A packet given to
+// send first waits for the link to become free, takes datalen / rate
+// to be serialized, and then is held for the delay before it is
+// handed back by deliver.  It does not touch the event loop, and the
+// caller is responsible for calling deliver at expiry.
+class NetEm {
+public:
+  explicit NetEm(const NetEmConfig &config);
+
+  // send puts the packet in |data| of length |datalen| into the link
+  // at |ts|.  It returns false if the packet is lost or dropped.
+  bool send(void *user_data, const ngtcp2_addr &local_addr,
+            const ngtcp2_addr &remote_addr, unsigned int ecn,
+            const uint8_t *data, size_t datalen, ngtcp2_tstamp ts);
+  // expiry returns the time when the next packet leaves the link, or
+  // UINT64_MAX if the link is empty.
+  ngtcp2_tstamp expiry() const {
+    return pq_.empty() ? UINT64_MAX : pq_.front()->ts;
+  }
+  // deliver calls |f| with each packet which leaves the link by |ts|
+  // in the order of departure.
+  template <typename F> void deliver(ngtcp2_tstamp ts, F f) {
+    while (!pq_.empty() && pq_.front()->ts <= ts) {
+      std::pop_heap(std::begin(pq_), std::end(pq_), greater);
+      auto pkt = std::move(pq_.back());
+      pq_.pop_back();
+
+      f(*pkt);
+    }
+  }
+  // size returns the number of packets in the link.
+  size_t size() const { return pq_.size(); }
+  // nlost returns the number of packets lost.
+  uint64_t nlost() const { return nlost_; }
+  // ndropped returns the number of packets dropped because the queue
+  // is full.
+  uint64_t ndropped() const { return ndropped_; }
+
+private:
+  static bool greater(const std::unique_ptr<NetEmPacket> &a,
+                      const std::unique_ptr<NetEmPacket> &b) {
+    return a->ts > b->ts || (a->ts == b->ts && a->seq > b->seq);
+  }
+
+  // lose returns true if the next packet is lost.
+  bool lose();
+  // uniform returns a random number in [0, 1).
+  double uniform() {
+    return std::uniform_real_distribution<>(0, 1)(randgen_);
+  }
+
+  NetEmConfig config_;
+  std::mt19937_64 randgen_;
+  // pq_ is the min-heap of the packets in the link ordered by
+  // departure time.
+  std::vector<std::unique_ptr<NetEmPacket>> pq_;
+  // link_ts_ is the time when the link finishes serializing the
+  // packets accepted so far.
+  ngtcp2_tstamp link_ts_;
+  uint64_t seq_;
+  uint64_t nlost_;
+  uint64_t ndropped_;
+  // ge_bad_ is true if Gilbert-Elliott model is in the bad state.
+  bool ge_bad_;
+};
+
+} // namespace ngtcp2
+
+#endif // NETEM_H
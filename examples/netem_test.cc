@@ -0,0 +1,174 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "netem_test.h"
+
+#include <vector>
+
+#include <CUnit/CUnit.h>
+
+#include "netem.h"
+
+namespace ngtcp2 {
+
+void test_netem_parse_config() {
+  auto config = parse_netem_config(
+      "delay=50ms,jitter=5ms,rate=1M,limit=64K,loss=0.01,reorder=0.5,seed=7");
+
+  CU_ASSERT(config.has_value());
+  CU_ASSERT(50 * NGTCP2_MILLISECONDS == config->delay);
+  CU_ASSERT(5 * NGTCP2_MILLISECONDS == config->jitter);
+  CU_ASSERT(1 << 20 == config->rate);
+  CU_ASSERT(64 << 10 == config->limit);
+  CU_ASSERT(0.01 == config->loss);
+  CU_ASSERT(0.5 == config->reorder);
+  CU_ASSERT(7 == config->seed);
+  CU_ASSERT(!config->gilbert_elliott);
+
+  config = parse_netem_config("ge=0.01/0.3");
+
+  CU_ASSERT(config.has_value());
+  CU_ASSERT(config->gilbert_elliott);
+  CU_ASSERT(0.01 == config->ge_p);
+  CU_ASSERT(0.3 == config->ge_r);
+  CU_ASSERT(1. == config->ge_loss_bad);
+  CU_ASSERT(0. == config->ge_loss_good);
+
+  config = parse_netem_config("ge=0.01/0.3/0.5/0.001");
+
+  CU_ASSERT(config.has_value());
+  CU_ASSERT(0.5 == config->ge_loss_bad);
+  CU_ASSERT(0.001 == config->ge_loss_good);
+
+  CU_ASSERT(!parse_netem_config("delay").has_value());
+  CU_ASSERT(!parse_netem_config("delay=1ms,jitter=2ms").has_value());
+  CU_ASSERT(!parse_netem_config("loss=1.5").has_value());
+  CU_ASSERT(!parse_netem_config("loss=0.1x").has_value());
+  CU_ASSERT(!parse_netem_config("ge=0.1").has_value());
+  CU_ASSERT(!parse_netem_config("foo=1").has_value());
+}
+
+namespace {
+std::vector<uint64_t> deliver_all(NetEm &netem, ngtcp2_tstamp ts) {
+  std::vector<uint64_t> v;
+
+  netem.deliver(ts, [&v](const NetEmPacket &pkt) { v.push_back(pkt.ts); });
+
+  return v;
+}
+} // namespace
+
+void test_netem_rate() {
+  sockaddr_in sin{
+      .sin_family = AF_INET,
+  };
+  ngtcp2_addr addr{
+      .addr = reinterpret_cast<sockaddr *>(&sin),
+      .addrlen = sizeof(sin),
+  };
+  uint8_t data[1000]{};
+
+  // 1000 bytes take 1ms on 1MB/s link, and the link holds 2000
+  // bytes which have not been serialized yet.
+  NetEm netem(NetEmConfig{
+      .delay = 10 * NGTCP2_MILLISECONDS,
+      .rate = 1000000,
+      .limit = 2000,
+  });
+
+  CU_ASSERT(UINT64_MAX == netem.expiry());
+  CU_ASSERT(netem.send(nullptr, addr, addr, 0, data, sizeof(data), 0));
+  CU_ASSERT(netem.send(nullptr, addr, addr, 0, data, sizeof(data), 0));
+  CU_ASSERT(!netem.send(nullptr, addr, addr, 0, data, sizeof(data), 0));
+  CU_ASSERT(1 == netem.ndropped());
+  CU_ASSERT(2 == netem.size());
+  CU_ASSERT(11 * NGTCP2_MILLISECONDS == netem.expiry());
+
+  auto v = deliver_all(netem, 11 * NGTCP2_MILLISECONDS);
+
+  CU_ASSERT(1 == v.size());
+  CU_ASSERT(11 * NGTCP2_MILLISECONDS == v[0]);
+  CU_ASSERT(12 * NGTCP2_MILLISECONDS == netem.expiry());
+
+  // The link is idle again.
+  CU_ASSERT(netem.send(nullptr, addr, addr, 0, data, sizeof(data),
+                       20 * NGTCP2_MILLISECONDS));
+
+  v = deliver_all(netem, UINT64_MAX);
+
+  CU_ASSERT(2 == v.size());
+  CU_ASSERT(12 * NGTCP2_MILLISECONDS == v[0]);
+  CU_ASSERT(31 * NGTCP2_MILLISECONDS == v[1]);
+  CU_ASSERT(0 == netem.size());
+}
+
+void test_netem_loss() {
+  sockaddr_in sin{
+      .sin_family = AF_INET,
+  };
+  ngtcp2_addr addr{
+      .addr = reinterpret_cast<sockaddr *>(&sin),
+      .addrlen = sizeof(sin),
+  };
+  uint8_t data[100]{};
+
+  {
+    NetEm netem(NetEmConfig{
+        .loss = 1.,
+    });
+
+    CU_ASSERT(!netem.send(nullptr, addr, addr, 0, data, sizeof(data), 0));
+    CU_ASSERT(1 == netem.nlost());
+  }
+
+  // Gilbert-Elliott model which never leaves the bad state once it
+  // enters.
+  {
+    NetEm netem(NetEmConfig{
+        .gilbert_elliott = true,
+        .ge_p = 1.,
+        .ge_loss_bad = 1.,
+    });
+
+    for (size_t i = 0; i < 10; ++i) {
+      CU_ASSERT(!netem.send(nullptr, addr, addr, 0, data, sizeof(data), 0));
+    }
+
+    CU_ASSERT(10 == netem.nlost());
+  }
+
+  // Packets which skip the delay overtake the others.
+  {
+    NetEm netem(NetEmConfig{
+        .delay = 10 * NGTCP2_MILLISECONDS,
+        .reorder = 1.,
+    });
+
+    CU_ASSERT(netem.send(nullptr, addr, addr, 0, data, sizeof(data),
+                         NGTCP2_MILLISECONDS));
+    CU_ASSERT(NGTCP2_MILLISECONDS == netem.expiry());
+  }
+}
+
+} // namespace ngtcp2
@@ -0,0 +1,233 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef PATH_CACHE_H
+#define PATH_CACHE_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include <ngtcp2/ngtcp2.h>
+
+// PathCache remembers the congestion control state which connections
+// learned on the paths to the remote endpoints, so that the next
+// connection to the same place starts with it through
+// ngtcp2_settings.cc_resume instead of slow start.  A path is keyed
+// by the prefix of the remote address, /24 for IPv4 and /48 for IPv6,
+// because the hosts of a POP usually share it.  The cache is shared
+// by the load generation workers.
+//
+// Timestamps are wall-clock nanoseconds so that the entries saved to
+// a file keep aging across runs.
+class PathCache {
+public:
+  explicit PathCache(ngtcp2_duration lifetime = 600 * NGTCP2_SECONDS,
+                     size_t max_entries = 4096)
+      : lifetime_(lifetime), max_entries_(max_entries) {}
+
+  PathCache(const PathCache &) = delete;
+  PathCache &operator=(const PathCache &) = delete;
+
+  // key returns the address prefix of |sa|, e.g., "192.0.2.0/24".  It
+  // returns an empty string if the address family is not supported.
+  static std::string key(const sockaddr *sa) {
+    std::array<char, INET6_ADDRSTRLEN> buf;
+
+    switch (sa->sa_family) {
+    case AF_INET: {
+      auto addr = reinterpret_cast<const sockaddr_in *>(sa)->sin_addr;
+      auto p = reinterpret_cast<uint8_t *>(&addr);
+
+      p[3] = 0;
+
+      if (!inet_ntop(AF_INET, &addr, buf.data(), buf.size())) {
+        return "";
+      }
+
+      return std::string{buf.data()} + "/24";
+    }
+    case AF_INET6: {
+      auto addr = reinterpret_cast<const sockaddr_in6 *>(sa)->sin6_addr;
+
+      memset(addr.s6_addr + 6, 0, sizeof(addr.s6_addr) - 6);
+
+      if (!inet_ntop(AF_INET6, &addr, buf.data(), buf.size())) {
+        return "";
+      }
+
+      return std::string{buf.data()} + "/48";
+    }
+    default:
+      return "";
+    }
+  }
+
+  // get returns the congestion control state of the path to |sa| if
+  // it was stored within the lifetime before |now|.
+  std::optional<ngtcp2_cc_resume_params> get(const sockaddr *sa,
+                                             ngtcp2_tstamp now) const {
+    auto k = key(sa);
+    if (k.empty()) {
+      return {};
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+
+    auto it = entries_.find(k);
+    if (it == std::end(entries_) || expired((*it).second, now)) {
+      return {};
+    }
+
+    return (*it).second.params;
+  }
+
+  // put stores |params| for the path to |sa|.  |params| without a
+  // congestion window is ignored.  If the cache is full, the expired
+  // entries are removed, and then the oldest one if it is still full.
+  void put(const sockaddr *sa, const ngtcp2_cc_resume_params &params,
+           ngtcp2_tstamp now) {
+    if (!params.cwnd) {
+      return;
+    }
+
+    auto k = key(sa);
+    if (k.empty()) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+
+    insert(std::move(k), params, now);
+  }
+
+  // load reads the entries written by save from |path|.  It returns 0
+  // if it succeeds, or -1.
+  int load(const char *path) {
+    std::ifstream f(path);
+    if (!f) {
+      return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+
+    std::string k;
+    ngtcp2_tstamp ts;
+    ngtcp2_cc_resume_params params;
+
+    while (f >> k >> ts >> params.min_rtt >> params.max_bw >> params.cwnd) {
+      insert(std::move(k), params, ts);
+    }
+
+    return f.eof() ? 0 : -1;
+  }
+
+  // save writes the entries to |path| one per line: the address
+  // prefix, the time when the entry was stored, min_rtt, max_bw, and
+  // cwnd.  It returns 0 if it succeeds, or -1.
+  int save(const char *path) const {
+    std::ofstream f(path);
+    if (!f) {
+      return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+
+    for (auto &[k, ent] : entries_) {
+      f << k << ' ' << ent.ts << ' ' << ent.params.min_rtt << ' '
+        << ent.params.max_bw << ' ' << ent.params.cwnd << '\n';
+    }
+
+    f.close();
+
+    return f ? 0 : -1;
+  }
+
+  // size returns the number of entries including the expired ones.
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mu_);
+
+    return entries_.size();
+  }
+
+private:
+  struct Entry {
+    ngtcp2_cc_resume_params params;
+    // ts is the time when the entry was stored.
+    ngtcp2_tstamp ts;
+  };
+
+  bool expired(const Entry &ent, ngtcp2_tstamp now) const {
+    return ent.ts + lifetime_ <= now;
+  }
+
+  void insert(std::string k, const ngtcp2_cc_resume_params &params,
+              ngtcp2_tstamp now) {
+    if (auto it = entries_.find(k); it != std::end(entries_)) {
+      if ((*it).second.ts <= now) {
+        (*it).second = {params, now};
+      }
+
+      return;
+    }
+
+    if (entries_.size() >= max_entries_) {
+      std::erase_if(entries_,
+                    [this, now](auto &kv) { return expired(kv.second, now); });
+    }
+
+    if (entries_.size() >= max_entries_) {
+      auto oldest = std::begin(entries_);
+
+      for (auto it = std::begin(entries_); it != std::end(entries_); ++it) {
+        if ((*it).second.ts < (*oldest).second.ts) {
+          oldest = it;
+        }
+      }
+
+      entries_.erase(oldest);
+    }
+
+    entries_.emplace(std::move(k), Entry{params, now});
+  }
+
+  mutable std::mutex mu_;
+  std::unordered_map<std::string, Entry> entries_;
+  ngtcp2_duration lifetime_;
+  size_t max_entries_;
+};
+
+#endif // PATH_CACHE_H
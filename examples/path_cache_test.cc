@@ -0,0 +1,151 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "path_cache_test.h"
+
+#include <unistd.h>
+
+#include <CUnit/CUnit.h>
+
+#include "path_cache.h"
+
+namespace ngtcp2 {
+
+namespace {
+sockaddr_in make_sin(const char *addr) {
+  sockaddr_in sin{};
+
+  sin.sin_family = AF_INET;
+  inet_pton(AF_INET, addr, &sin.sin_addr);
+
+  return sin;
+}
+} // namespace
+
+namespace {
+sockaddr_in6 make_sin6(const char *addr) {
+  sockaddr_in6 sin6{};
+
+  sin6.sin6_family = AF_INET6;
+  inet_pton(AF_INET6, addr, &sin6.sin6_addr);
+
+  return sin6;
+}
+} // namespace
+
+void test_path_cache_key() {
+  auto a = make_sin("192.0.2.17");
+  auto b = make_sin6("2001:db8:1:2::1");
+
+  CU_ASSERT("192.0.2.0/24" ==
+            PathCache::key(reinterpret_cast<const sockaddr *>(&a)));
+  CU_ASSERT("2001:db8:1::/48" ==
+            PathCache::key(reinterpret_cast<const sockaddr *>(&b)));
+}
+
+void test_path_cache_get() {
+  constexpr auto lifetime = 10 * NGTCP2_SECONDS;
+  PathCache cache(lifetime, 2);
+  auto a = make_sin("192.0.2.17");
+  auto a2 = make_sin("192.0.2.200");
+  auto b = make_sin("198.51.100.1");
+  auto c = make_sin("203.0.113.1");
+  auto sa = reinterpret_cast<const sockaddr *>(&a);
+  auto sa2 = reinterpret_cast<const sockaddr *>(&a2);
+  auto sb = reinterpret_cast<const sockaddr *>(&b);
+  auto sc = reinterpret_cast<const sockaddr *>(&c);
+  ngtcp2_cc_resume_params params{
+      .min_rtt = 20 * NGTCP2_MILLISECONDS,
+      .max_bw = 12500000,
+      .cwnd = 250000,
+  };
+
+  CU_ASSERT(!cache.get(sa, 0));
+
+  cache.put(sa, params, 0);
+
+  // The hosts in the same prefix share the entry.
+  auto res = cache.get(sa2, lifetime - 1);
+
+  CU_ASSERT(res.has_value());
+  CU_ASSERT(20 * NGTCP2_MILLISECONDS == res->min_rtt);
+  CU_ASSERT(12500000 == res->max_bw);
+  CU_ASSERT(250000 == res->cwnd);
+  CU_ASSERT(!cache.get(sa, lifetime));
+
+  // The parameters without a congestion window are not stored.
+  cache.put(sb, ngtcp2_cc_resume_params{}, 0);
+
+  CU_ASSERT(1 == cache.size());
+
+  params.cwnd = 500000;
+  cache.put(sa2, params, 1);
+
+  CU_ASSERT(500000 == cache.get(sa, 1)->cwnd);
+
+  // The oldest entry is evicted when the cache is full.
+  cache.put(sb, params, 2);
+  cache.put(sc, params, 3);
+
+  CU_ASSERT(2 == cache.size());
+  CU_ASSERT(!cache.get(sa, 3));
+  CU_ASSERT(cache.get(sb, 3).has_value());
+  CU_ASSERT(cache.get(sc, 3).has_value());
+}
+
+void test_path_cache_save_load() {
+  PathCache cache;
+  auto a = make_sin6("2001:db8::1");
+  auto sa = reinterpret_cast<const sockaddr *>(&a);
+  ngtcp2_cc_resume_params params{
+      .min_rtt = 30 * NGTCP2_MILLISECONDS,
+      .max_bw = 0,
+      .cwnd = 120000,
+  };
+  char path[] = "/tmp/path_cache_test.XXXXXX";
+  auto fd = mkstemp(path);
+
+  CU_ASSERT(fd != -1);
+
+  close(fd);
+
+  cache.put(sa, params, 1000);
+
+  CU_ASSERT(0 == cache.save(path));
+
+  PathCache cache2;
+
+  CU_ASSERT(0 == cache2.load(path));
+
+  auto res = cache2.get(sa, 1000);
+
+  CU_ASSERT(res.has_value());
+  CU_ASSERT(30 * NGTCP2_MILLISECONDS == res->min_rtt);
+  CU_ASSERT(0 == res->max_bw);
+  CU_ASSERT(120000 == res->cwnd);
+
+  unlink(path);
+}
+
+} // namespace ngtcp2
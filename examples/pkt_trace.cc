@@ -0,0 +1,188 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "pkt_trace.h"
+
+#include <cassert>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+using namespace std::literals;
+
+namespace {
+constexpr auto MAGIC = "NGPT"sv;
+constexpr uint8_t VERSION = 1;
+} // namespace
+
+namespace {
+void put_uint8(std::vector<uint8_t> &buf, uint8_t n) { buf.push_back(n); }
+} // namespace
+
+namespace {
+void put_uint32(std::vector<uint8_t> &buf, uint32_t n) {
+  for (auto shift = 24; shift >= 0; shift -= 8) {
+    buf.push_back(static_cast<uint8_t>(n >> shift));
+  }
+}
+} // namespace
+
+namespace {
+void put_bytes(std::vector<uint8_t> &buf, const void *data, size_t datalen) {
+  auto p = static_cast<const uint8_t *>(data);
+  buf.insert(std::end(buf), p, p + datalen);
+}
+} // namespace
+
+namespace {
+void put_addr(std::vector<uint8_t> &buf, const ngtcp2_addr &addr) {
+  assert(addr.addrlen <= UINT8_MAX);
+
+  put_uint8(buf, static_cast<uint8_t>(addr.addrlen));
+  put_bytes(buf, addr.addr, addr.addrlen);
+}
+} // namespace
+
+PktTrace::PktTrace() : fp_(nullptr), started_(false) {}
+
+PktTrace::~PktTrace() {
+  if (fp_) {
+    fclose(fp_);
+  }
+}
+
+int PktTrace::open(const std::string &path) {
+  fp_ = fopen(path.c_str(), "wb");
+  if (!fp_) {
+    std::cerr << "Could not open trace file " << path << ": "
+              << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  fwrite(MAGIC.data(), 1, MAGIC.size(), fp_);
+  fputc(VERSION, fp_);
+
+  return 0;
+}
+
+int PktTrace::start(ngtcp2_conn *conn, const ngtcp2_path *path,
+                    std::string_view cipher, ngtcp2_cc_algo cc_algo,
+                    ngtcp2_tstamp ts) {
+  assert(!started_);
+
+  if (!fp_) {
+    return -1;
+  }
+
+  std::array<uint8_t, 1024> tp;
+
+  auto tplen = ngtcp2_conn_encode_local_transport_params(conn, tp.data(),
+                                                         tp.size());
+  if (tplen < 0) {
+    return -1;
+  }
+
+  buf_.clear();
+  put_uint8(buf_, ngtcp2_conn_is_server(conn));
+  put_uint8(buf_, static_cast<uint8_t>(cc_algo));
+  put_uint8(buf_, static_cast<uint8_t>(std::min(cipher.size(), size_t{255})));
+  put_bytes(buf_, cipher.data(), std::min(cipher.size(), size_t{255}));
+  put_addr(buf_, path->local);
+  put_addr(buf_, path->remote);
+  put_uint32(buf_, static_cast<uint32_t>(tplen));
+  put_bytes(buf_, tp.data(), static_cast<size_t>(tplen));
+
+  auto offset = buf_.size();
+
+  for (size_t len = 4096;; len *= 2) {
+    buf_.resize(offset + len);
+
+    auto nwrite =
+        ngtcp2_conn_encode_snapshot(conn, buf_.data() + offset, len);
+    if (nwrite >= 0) {
+      buf_.resize(offset + static_cast<size_t>(nwrite));
+      break;
+    }
+
+    if (nwrite != NGTCP2_ERR_NOBUF) {
+      return -1;
+    }
+  }
+
+  write_record(PKT_TRACE_START, ts);
+
+  started_ = true;
+
+  return 0;
+}
+
+void PktTrace::write_recv(const ngtcp2_path *path, uint32_t ecn,
+                          const uint8_t *data, size_t datalen,
+                          size_t gso_size, ngtcp2_tstamp ts) {
+  assert(started_);
+
+  buf_.clear();
+  put_uint8(buf_, static_cast<uint8_t>(ecn));
+  put_uint32(buf_, static_cast<uint32_t>(gso_size));
+  put_addr(buf_, path->local);
+  put_addr(buf_, path->remote);
+  put_bytes(buf_, data, datalen);
+
+  write_record(PKT_TRACE_RECV, ts);
+}
+
+void PktTrace::write_send(size_t pktlen, ngtcp2_tstamp ts) {
+  assert(started_);
+
+  buf_.clear();
+  put_uint32(buf_, static_cast<uint32_t>(pktlen));
+
+  write_record(PKT_TRACE_SEND, ts);
+}
+
+void PktTrace::write_expiry(ngtcp2_tstamp ts) {
+  assert(started_);
+
+  buf_.clear();
+
+  write_record(PKT_TRACE_EXPIRY, ts);
+}
+
+void PktTrace::write_record(PktTraceType type, ngtcp2_tstamp ts) {
+  std::array<uint8_t, 1 + 8 + 4> hd;
+  auto p = hd.data();
+
+  *p++ = type;
+  for (auto shift = 56; shift >= 0; shift -= 8) {
+    *p++ = static_cast<uint8_t>(ts >> shift);
+  }
+  for (auto shift = 24; shift >= 0; shift -= 8) {
+    *p++ = static_cast<uint8_t>(buf_.size() >> shift);
+  }
+
+  fwrite(hd.data(), 1, hd.size(), fp_);
+  fwrite(buf_.data(), 1, buf_.size(), fp_);
+}
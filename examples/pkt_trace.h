@@ -0,0 +1,120 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef PKT_TRACE_H
+#define PKT_TRACE_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <ngtcp2/ngtcp2.h>
+
+// PktTrace records what a connection sees on the wire, so that the
+// traffic can be replayed later against a fresh ngtcp2_conn with
+// bench_replay.  Recording begins with a snapshot of the connection
+// (see ngtcp2_conn_encode_snapshot), which carries the 1RTT secrets,
+// and is followed by the datagrams received, the packets written, and
+// the timer expirations, each with the timestamp passed to the
+// library.  Because of the secrets, a trace must be protected as
+// well as the TLS keys themselves.
+//
+// The file starts with the 4 bytes magic "NGPT" and 1 byte version,
+// followed by records.  All integers are in network byte order.  A
+// record is:
+//
+//   type (1) | ts (8) | length (4) | body (length)
+//
+// PKT_TRACE_START body:
+//   role (1, 1 for server) | cc_algo (1) | cipher name length (1) |
+//   cipher name | local address length (1) | local address |
+//   remote address length (1) | remote address |
+//   local transport parameters length (4) | local transport parameters |
+//   snapshot (the rest)
+//
+// PKT_TRACE_RECV body:
+//   ecn (1) | gso_size (4) | local address length (1) | local address |
+//   remote address length (1) | remote address | datagrams (the rest)
+//
+// PKT_TRACE_SEND body:
+//   packet length (4)
+//
+// PKT_TRACE_EXPIRY has no body.
+//
+// The addresses are struct sockaddr as is.  bench/bench_replay.c
+// must be updated together with this format.
+enum PktTraceType : uint8_t {
+  PKT_TRACE_START = 0x01,
+  PKT_TRACE_RECV = 0x02,
+  PKT_TRACE_SEND = 0x03,
+  PKT_TRACE_EXPIRY = 0x04,
+};
+
+class PktTrace {
+public:
+  PktTrace();
+  ~PktTrace();
+
+  PktTrace(const PktTrace &) = delete;
+  PktTrace &operator=(const PktTrace &) = delete;
+
+  // open creates the trace file at |path|.  It returns 0 if it
+  // succeeds, or -1.
+  int open(const std::string &path);
+  // start takes a snapshot of |conn| and writes PKT_TRACE_START
+  // record.  |cipher| is the name of the negotiated TLS cipher suite.
+  // A snapshot can only be taken while |conn| has nothing in flight,
+  // so the caller should try again later if this function returns
+  // -1.  It returns 0 if recording has started.
+  int start(ngtcp2_conn *conn, const ngtcp2_path *path,
+            std::string_view cipher, ngtcp2_cc_algo cc_algo,
+            ngtcp2_tstamp ts);
+  // started returns true if recording has started.
+  bool started() const { return started_; }
+  // write_recv records the datagrams in |data| of length |datalen|
+  // which are about to be passed to ngtcp2_conn_read_pkts.
+  void write_recv(const ngtcp2_path *path, uint32_t ecn, const uint8_t *data,
+                  size_t datalen, size_t gso_size, ngtcp2_tstamp ts);
+  // write_send records a packet of length |pktlen| written by the
+  // connection.
+  void write_send(size_t pktlen, ngtcp2_tstamp ts);
+  // write_expiry records the call of ngtcp2_conn_handle_expiry.
+  void write_expiry(ngtcp2_tstamp ts);
+
+private:
+  void write_record(PktTraceType type, ngtcp2_tstamp ts);
+
+  FILE *fp_;
+  // buf_ is the body of the record which is being written.
+  std::vector<uint8_t> buf_;
+  bool started_;
+};
+
+#endif // PKT_TRACE_H
@@ -0,0 +1,268 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "qlog_ring.h"
+
+#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+constexpr size_t HDRLEN = 64;
+static_assert(sizeof(QlogRing::Header) <= HDRLEN);
+} // namespace
+
+namespace {
+constexpr size_t MIN_SIZE = 64 * 1024;
+} // namespace
+
+namespace {
+// record_size returns the size of a record with |datalen| bytes of
+// data including padding.
+constexpr uint64_t record_size(size_t datalen) {
+  return (sizeof(QlogRing::Record) + datalen + 7) & ~static_cast<uint64_t>(7);
+}
+} // namespace
+
+namespace {
+// load loads |v| which is shared with the other processes.
+uint64_t load(const uint64_t &v, std::memory_order order) {
+  return std::atomic_ref<uint64_t>(const_cast<uint64_t &>(v)).load(order);
+}
+} // namespace
+
+namespace {
+// store stores |n| to |v| which is shared with the other processes.
+void store(uint64_t &v, uint64_t n, std::memory_order order) {
+  std::atomic_ref<uint64_t>(v).store(n, order);
+}
+} // namespace
+
+namespace {
+// ring_copy_in copies |data| of length |len| to the data area |ring|
+// of length |size| at |pos|, wrapping around the end.
+void ring_copy_in(uint8_t *ring, size_t size, uint64_t pos, const void *data,
+                  size_t len) {
+  auto idx = static_cast<size_t>(pos & (size - 1));
+  auto n = std::min(len, size - idx);
+  auto p = static_cast<const uint8_t *>(data);
+
+  memcpy(ring + idx, p, n);
+  memcpy(ring, p + n, len - n);
+}
+} // namespace
+
+namespace {
+// ring_copy_out copies |len| bytes at |pos| of the data area |ring|
+// of length |size| to |dest|.
+void ring_copy_out(void *dest, const uint8_t *ring, size_t size, uint64_t pos,
+                   size_t len) {
+  auto idx = static_cast<size_t>(pos & (size - 1));
+  auto n = std::min(len, size - idx);
+  auto p = static_cast<uint8_t *>(dest);
+
+  memcpy(p, ring + idx, n);
+  memcpy(p + n, ring, len - n);
+}
+} // namespace
+
+QlogRing::QlogRing() : hdr_(nullptr), data_(nullptr), size_(0), maplen_(0) {}
+
+QlogRing::~QlogRing() {
+  if (hdr_) {
+    munmap(hdr_, maplen_);
+  }
+}
+
+int QlogRing::open(const std::string &path, size_t size) {
+  assert(!hdr_);
+
+  size_t n = MIN_SIZE;
+  for (; n < size; n *= 2)
+    ;
+
+  auto fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    std::cerr << "Could not open qlog ring " << path << ": "
+              << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  auto maplen = HDRLEN + n;
+
+  if (ftruncate(fd, static_cast<off_t>(maplen)) != 0) {
+    std::cerr << "Could not resize qlog ring " << path << ": "
+              << strerror(errno) << std::endl;
+    ::close(fd);
+    return -1;
+  }
+
+  auto p = mmap(nullptr, maplen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  ::close(fd);
+
+  if (p == MAP_FAILED) {
+    std::cerr << "Could not map qlog ring " << path << ": " << strerror(errno)
+              << std::endl;
+    return -1;
+  }
+
+  hdr_ = static_cast<Header *>(p);
+  data_ = static_cast<uint8_t *>(p) + HDRLEN;
+  size_ = n;
+  maplen_ = maplen;
+
+  hdr_->version = VERSION;
+  hdr_->hdrlen = HDRLEN;
+  hdr_->size = n;
+  hdr_->head = 0;
+  hdr_->tail = 0;
+
+  // A reader checks magic first, so that it never sees the partially
+  // initialized header.
+  store(hdr_->magic, MAGIC, std::memory_order_release);
+
+  return 0;
+}
+
+bool QlogRing::append(RecordType type, uint64_t id, const void *data,
+                      size_t datalen) {
+  auto need = record_size(datalen);
+
+  if (!hdr_ || need > size_ / 2) {
+    return false;
+  }
+
+  auto head = load(hdr_->head, std::memory_order_relaxed);
+  auto tail = load(hdr_->tail, std::memory_order_relaxed);
+
+  if (head + need - tail > size_) {
+    do {
+      Record rec;
+
+      ring_copy_out(&rec, data_, size_, tail, sizeof(rec));
+      tail += record_size(rec.len);
+    } while (head + need - tail > size_);
+
+    store(hdr_->tail, tail, std::memory_order_relaxed);
+
+    // The new tail must be visible before the records are
+    // overwritten, so that a reader which sees the overwritten bytes
+    // also sees that the record is gone.  This is the same fence
+    // which the writer of seqlock issues.
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  auto rec = Record{
+      .len = static_cast<uint32_t>(datalen),
+      .type = type,
+      .id = id,
+      .ts = static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::system_clock::now().time_since_epoch())
+              .count()),
+  };
+
+  ring_copy_in(data_, size_, head, &rec, sizeof(rec));
+  if (datalen) {
+    ring_copy_in(data_, size_, head + sizeof(rec), data, datalen);
+  }
+
+  store(hdr_->head, head + need, std::memory_order_release);
+
+  return true;
+}
+
+int qlog_ring_snapshot(std::vector<QlogRingEntry> &entries,
+                       const uint8_t *map, size_t maplen) {
+  entries.clear();
+
+  if (maplen < HDRLEN) {
+    return -1;
+  }
+
+  auto hdr = reinterpret_cast<const QlogRing::Header *>(map);
+
+  if (load(hdr->magic, std::memory_order_acquire) != QlogRing::MAGIC ||
+      hdr->version != QlogRing::VERSION || hdr->hdrlen < sizeof(*hdr) ||
+      hdr->size < MIN_SIZE || (hdr->size & (hdr->size - 1)) ||
+      hdr->size > maplen - hdr->hdrlen) {
+    return -1;
+  }
+
+  auto data = map + hdr->hdrlen;
+  auto size = static_cast<size_t>(hdr->size);
+  auto head = load(hdr->head, std::memory_order_acquire);
+  auto pos = load(hdr->tail, std::memory_order_acquire);
+
+  while (pos < head) {
+    QlogRing::Record rec;
+
+    ring_copy_out(&rec, data, size, pos, sizeof(rec));
+
+    // rec is garbage if the writer has overwritten it.  It is
+    // discarded below in that case.
+    auto valid = record_size(rec.len) <= size / 2;
+
+    QlogRingEntry ent{
+        .type = rec.type,
+        .id = rec.id,
+        .ts = rec.ts,
+        .data{},
+    };
+
+    if (valid) {
+      ent.data.resize(rec.len);
+      ring_copy_out(ent.data.data(), data, size, pos + sizeof(rec), rec.len);
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (auto tail = load(hdr->tail, std::memory_order_relaxed); tail > pos) {
+      // The writer has overwritten the record, and the ones before
+      // it.  Continue from the oldest record which is still intact.
+      entries.clear();
+      pos = tail;
+      continue;
+    }
+
+    if (!valid) {
+      return -1;
+    }
+
+    entries.push_back(std::move(ent));
+
+    pos += record_size(rec.len);
+  }
+
+  return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef QLOG_RING_H
+#define QLOG_RING_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// QlogRing is a flight recorder of qlog.  It is a file which is
+// mmap(2)ed and shared with an external reader, so that appending a
+// record is just a memory copy and never makes a system call.  When
+// the ring is full, the oldest records are overwritten, so that the
+// ring always holds the latest records.  A ring has a single writer
+// thread.  Any number of the processes which map the file can read
+// it with qlog_ring_snapshot while it is written.
+class QlogRing {
+public:
+  // MAGIC is "NGQLRING" in little endian.
+  static constexpr uint64_t MAGIC = 0x474e49524c51474eull;
+  static constexpr uint32_t VERSION = 1;
+
+  enum class RecordType : uint32_t {
+    // OPEN starts a qlog file.  Its data is the name of the file.
+    OPEN,
+    // DATA is a chunk of qlog written by a single qlog.write call.
+    DATA,
+    // CLOSE ends a qlog file.  It has no data.
+    CLOSE,
+  };
+
+  // Header is placed at the beginning of the file.  head and tail
+  // are the positions in the data area which increase monotonically.
+  // The position modulo size is the offset in the data area.
+  struct Header {
+    uint64_t magic;
+    uint32_t version;
+    // hdrlen is the offset of the data area from the beginning of
+    // the file.
+    uint32_t hdrlen;
+    // size is the size of the data area.  It is a power of 2.
+    uint64_t size;
+    // head is the position where the next record is written.  The
+    // records before head are complete.
+    uint64_t head;
+    // tail is the position of the oldest record which is not
+    // overwritten.  The writer updates it before it overwrites the
+    // records.
+    uint64_t tail;
+  };
+
+  // Record is the header of a record, which is followed by len bytes
+  // of data.  A record is padded to 8 bytes.
+  struct Record {
+    uint32_t len;
+    RecordType type;
+    // id identifies the qlog file which the record belongs to.
+    uint64_t id;
+    // ts is the time when the record was written in nanoseconds
+    // since the UNIX epoch.
+    uint64_t ts;
+  };
+
+  QlogRing();
+  ~QlogRing();
+
+  QlogRing(const QlogRing &) = delete;
+  QlogRing &operator=(const QlogRing &) = delete;
+
+  // open creates the ring file |path| whose data area is at least
+  // |size| bytes long, and maps it.  It returns 0 if it succeeds, or
+  // -1.
+  int open(const std::string &path, size_t size);
+
+  // append appends a record of |type| for qlog file |id| with |data|
+  // of length |datalen|, overwriting the oldest records if needed.
+  // It returns false if the record is larger than the half of the
+  // ring.
+  bool append(RecordType type, uint64_t id, const void *data,
+              size_t datalen);
+
+private:
+  Header *hdr_;
+  uint8_t *data_;
+  size_t size_;
+  size_t maplen_;
+};
+
+// QlogRingEntry is a record read from a ring.
+struct QlogRingEntry {
+  QlogRing::RecordType type;
+  uint64_t id;
+  uint64_t ts;
+  std::vector<uint8_t> data;
+};
+
+// qlog_ring_snapshot reads the records in the ring file mapped at
+// |map| of length |maplen| from the oldest to the latest, and stores
+// them in |entries|.  The records which the writer overwrites while
+// they are read are discarded.  It returns 0 if it succeeds, or -1
+// if |map| is not a ring.
+int qlog_ring_snapshot(std::vector<QlogRingEntry> &entries,
+                       const uint8_t *map, size_t maplen);
+
+#endif // QLOG_RING_H
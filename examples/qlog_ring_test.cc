@@ -0,0 +1,164 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "qlog_ring_test.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <CUnit/CUnit.h>
+
+#include "qlog_ring.h"
+
+namespace ngtcp2 {
+
+namespace {
+// snapshot maps the ring file |path| read-only as an external reader
+// does, and reads it.
+int snapshot(std::vector<QlogRingEntry> &entries, const char *path) {
+  auto fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    return -1;
+  }
+
+  struct stat st;
+
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  auto maplen = static_cast<size_t>(st.st_size);
+  auto map = mmap(nullptr, maplen, PROT_READ, MAP_SHARED, fd, 0);
+
+  close(fd);
+
+  if (map == MAP_FAILED) {
+    return -1;
+  }
+
+  auto rv =
+      qlog_ring_snapshot(entries, static_cast<const uint8_t *>(map), maplen);
+
+  munmap(map, maplen);
+
+  return rv;
+}
+} // namespace
+
+void test_qlog_ring_append() {
+  char path[] = "/tmp/qlog_ring_test.XXXXXX";
+  auto fd = mkstemp(path);
+
+  CU_ASSERT(fd != -1);
+
+  close(fd);
+
+  std::vector<QlogRingEntry> entries;
+
+  {
+    QlogRing ring;
+
+    CU_ASSERT(0 == ring.open(path, 4096));
+
+    CU_ASSERT(0 == snapshot(entries, path));
+    CU_ASSERT(entries.empty());
+
+    CU_ASSERT(ring.append(QlogRing::RecordType::OPEN, 7, "a.sqlog", 7));
+    CU_ASSERT(ring.append(QlogRing::RecordType::DATA, 7, "hello", 5));
+    CU_ASSERT(ring.append(QlogRing::RecordType::CLOSE, 7, nullptr, 0));
+
+    // A record larger than the half of the ring is rejected.
+    std::vector<uint8_t> big(64 * 1024);
+
+    CU_ASSERT(
+        !ring.append(QlogRing::RecordType::DATA, 7, big.data(), big.size()));
+  }
+
+  // The ring stays readable after the writer has gone.
+  CU_ASSERT(0 == snapshot(entries, path));
+  CU_ASSERT(3 == entries.size());
+  CU_ASSERT(QlogRing::RecordType::OPEN == entries[0].type);
+  CU_ASSERT(7 == entries[0].id);
+  CU_ASSERT("a.sqlog" == std::string(std::begin(entries[0].data),
+                                     std::end(entries[0].data)));
+  CU_ASSERT(QlogRing::RecordType::DATA == entries[1].type);
+  CU_ASSERT("hello" == std::string(std::begin(entries[1].data),
+                                   std::end(entries[1].data)));
+  CU_ASSERT(entries[0].ts <= entries[1].ts);
+  CU_ASSERT(QlogRing::RecordType::CLOSE == entries[2].type);
+  CU_ASSERT(entries[2].data.empty());
+
+  unlink(path);
+}
+
+void test_qlog_ring_overwrite() {
+  char path[] = "/tmp/qlog_ring_test.XXXXXX";
+  auto fd = mkstemp(path);
+
+  CU_ASSERT(fd != -1);
+
+  close(fd);
+
+  QlogRing ring;
+
+  CU_ASSERT(0 == ring.open(path, 64 * 1024));
+
+  // Each record takes 1024 bytes with its header, so that the ring
+  // holds 64 of them.  The records of odd sizes make them wrap
+  // around in the middle.
+  std::vector<uint8_t> data(1024 - sizeof(QlogRing::Record) - 5);
+  uint64_t n = 1000;
+
+  for (uint64_t i = 0; i < n; ++i) {
+    memset(data.data(), static_cast<int>(i), data.size());
+    CU_ASSERT(
+        ring.append(QlogRing::RecordType::DATA, i, data.data(), data.size()));
+  }
+
+  std::vector<QlogRingEntry> entries;
+
+  CU_ASSERT(0 == snapshot(entries, path));
+  CU_ASSERT(64 == entries.size());
+
+  for (size_t i = 0; i < entries.size(); ++i) {
+    auto &ent = entries[i];
+    auto id = n - entries.size() + i;
+
+    CU_ASSERT(id == ent.id);
+    CU_ASSERT(data.size() == ent.data.size());
+    CU_ASSERT(static_cast<uint8_t>(id) == ent.data.front());
+    CU_ASSERT(static_cast<uint8_t>(id) == ent.data.back());
+  }
+
+  unlink(path);
+}
+
+} // namespace ngtcp2
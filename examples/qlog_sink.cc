@@ -0,0 +1,533 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "qlog_sink.h"
+
+#include <cassert>
+#include <array>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <unordered_set>
+
+#include <unistd.h>
+
+#ifdef HAVE_ZLIB
+#  include <zlib.h>
+#endif // HAVE_ZLIB
+
+using namespace std::literals;
+
+struct QlogFile {
+  QlogSink *sink = nullptr;
+  std::string path;
+  // id identifies this file in QlogRing.
+  uint64_t id = 0;
+  // The following fields are only touched by the background thread
+  // except for ndropped.
+  FILE *fp = nullptr;
+  // failed is true if the file could not be opened or written.
+  bool failed = false;
+  std::vector<uint8_t> buf;
+#ifdef HAVE_ZLIB
+  z_stream zs{};
+  bool zinit = false;
+#endif // HAVE_ZLIB
+  // ndropped is the number of bytes dropped because the ring was
+  // full.
+  std::atomic<uint64_t> ndropped{0};
+};
+
+struct QlogSink::Ring {
+  std::unique_ptr<uint8_t[]> data{new uint8_t[RING_SIZE]};
+  // head is the position where the background thread reads next.
+  alignas(64) std::atomic<size_t> head{0};
+  // tail is the position where the producer thread writes next.
+  alignas(64) std::atomic<size_t> tail{0};
+};
+
+namespace {
+enum class RecordType : uint32_t {
+  DATA,
+  CLOSE,
+};
+
+// Record is the header of a chunk in a ring, which is followed by
+// len bytes of data.
+struct Record {
+  QlogFile *file;
+  uint32_t len;
+  RecordType type;
+};
+} // namespace
+
+namespace {
+// ring_copy_in copies |data| of length |len| to |ring| at |pos|,
+// wrapping around the end.
+void ring_copy_in(uint8_t *ring, size_t pos, const void *data, size_t len) {
+  auto idx = pos & (QlogSink::RING_SIZE - 1);
+  auto n = std::min(len, QlogSink::RING_SIZE - idx);
+  auto p = static_cast<const uint8_t *>(data);
+
+  memcpy(ring + idx, p, n);
+  memcpy(ring, p + n, len - n);
+}
+} // namespace
+
+namespace {
+// ring_copy_out copies |len| bytes at |pos| of |ring| to |dest|.
+void ring_copy_out(void *dest, const uint8_t *ring, size_t pos, size_t len) {
+  auto idx = pos & (QlogSink::RING_SIZE - 1);
+  auto n = std::min(len, QlogSink::RING_SIZE - idx);
+  auto p = static_cast<uint8_t *>(dest);
+
+  memcpy(p, ring + idx, n);
+  memcpy(p + n, ring, len - n);
+}
+} // namespace
+
+namespace {
+// file_flush writes the buffered data of |f|.  If |fin| is true, the
+// compressed stream is finished.
+void file_flush(QlogFile *f, bool compress, bool fin) {
+  if (f->failed) {
+    f->buf.clear();
+    return;
+  }
+
+  if (!f->fp) {
+    f->fp = fopen(f->path.c_str(), "wb");
+    if (!f->fp) {
+      std::cerr << "Could not open qlog file " << f->path << ": "
+                << strerror(errno) << std::endl;
+      f->failed = true;
+      f->buf.clear();
+      return;
+    }
+  }
+
+  if (!compress) {
+    if (!f->buf.empty() &&
+        fwrite(f->buf.data(), 1, f->buf.size(), f->fp) != f->buf.size()) {
+      f->failed = true;
+    }
+    f->buf.clear();
+    return;
+  }
+
+#ifdef HAVE_ZLIB
+  if (!f->zinit) {
+    f->zs = z_stream{};
+    if (deflateInit2(&f->zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                     MAX_WBITS + 16 /* gzip */, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      f->failed = true;
+      f->buf.clear();
+      return;
+    }
+    f->zinit = true;
+  }
+
+  std::array<uint8_t, 64 * 1024> out;
+
+  f->zs.next_in = f->buf.data();
+  f->zs.avail_in = f->buf.size();
+
+  for (;;) {
+    f->zs.next_out = out.data();
+    f->zs.avail_out = out.size();
+
+    auto rv = deflate(&f->zs, fin ? Z_FINISH : Z_NO_FLUSH);
+    if (rv == Z_STREAM_ERROR) {
+      f->failed = true;
+      break;
+    }
+
+    auto n = out.size() - f->zs.avail_out;
+
+    if (n && fwrite(out.data(), 1, n, f->fp) != n) {
+      f->failed = true;
+      break;
+    }
+
+    if (fin ? rv == Z_STREAM_END : f->zs.avail_out != 0) {
+      break;
+    }
+  }
+
+  f->buf.clear();
+#else  // !HAVE_ZLIB
+  (void)fin;
+#endif // !HAVE_ZLIB
+}
+} // namespace
+
+namespace {
+// file_close flushes and closes |f|, and deletes it.
+void file_close(QlogFile *f, bool compress) {
+  file_flush(f, compress, /* fin = */ true);
+
+#ifdef HAVE_ZLIB
+  if (f->zinit) {
+    deflateEnd(&f->zs);
+  }
+#endif // HAVE_ZLIB
+
+  if (f->fp) {
+    fclose(f->fp);
+  }
+
+  if (auto n = f->ndropped.load(std::memory_order_relaxed); n) {
+    std::cerr << "qlog: " << n << " bytes were dropped from " << f->path
+              << " because the writer could not keep up" << std::endl;
+  }
+
+  delete f;
+}
+} // namespace
+
+namespace {
+// files contains the files which are open.  It is only touched by
+// the background thread.
+std::unordered_set<QlogFile *> files;
+} // namespace
+
+QlogSink::QlogSink()
+    : stop_(false), compress_(false), ring_size_(0), next_id_(0) {}
+
+QlogSink::~QlogSink() {
+  if (!thread_.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lg(mu_);
+    stop_ = true;
+  }
+
+  cv_.notify_one();
+  thread_.join();
+}
+
+int QlogSink::start(bool compress) {
+#ifndef HAVE_ZLIB
+  if (compress) {
+    std::cerr << "qlog compression requires zlib" << std::endl;
+    return -1;
+  }
+#endif // !HAVE_ZLIB
+
+  compress_ = compress;
+  thread_ = std::thread([this]() { run(); });
+
+  return 0;
+}
+
+int QlogSink::start_ring(std::string dir, size_t size) {
+  if (access(dir.c_str(), W_OK) != 0) {
+    std::cerr << "Could not write qlog ring to " << dir << ": "
+              << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  ring_dir_ = std::move(dir);
+  ring_size_ = size;
+
+  return 0;
+}
+
+QlogFile *QlogSink::open(std::string path) {
+  if (!ring_dir_.empty()) {
+    auto f = new QlogFile{};
+    f->sink = this;
+    f->id = next_id_.fetch_add(1, std::memory_order_relaxed);
+
+    if (auto pos = path.rfind('/'); pos != std::string::npos) {
+      path.erase(0, pos + 1);
+    }
+
+    f->path = std::move(path);
+
+    if (auto ring = get_qlog_ring(); ring) {
+      ring->append(QlogRing::RecordType::OPEN, f->id, f->path.data(),
+                   f->path.size());
+    }
+
+    return f;
+  }
+
+  assert(thread_.joinable());
+
+  if (compress_) {
+    path += ".gz";
+  }
+
+  auto f = new QlogFile{};
+  f->sink = this;
+  f->path = std::move(path);
+
+  return f;
+}
+
+QlogSink::Ring *QlogSink::get_ring() {
+  struct ThreadRing {
+    QlogSink *sink;
+    Ring *ring;
+  };
+  thread_local ThreadRing tr;
+
+  if (tr.sink == this) {
+    return tr.ring;
+  }
+
+  auto ring = std::make_unique<Ring>();
+
+  tr.sink = this;
+  tr.ring = ring.get();
+
+  std::lock_guard<std::mutex> lg(mu_);
+  rings_.push_back(std::move(ring));
+
+  return tr.ring;
+}
+
+QlogRing *QlogSink::get_qlog_ring() {
+  struct ThreadQlogRing {
+    QlogSink *sink;
+    QlogRing *ring;
+  };
+  thread_local ThreadQlogRing tr;
+
+  if (tr.sink == this) {
+    return tr.ring;
+  }
+
+  tr.sink = this;
+  tr.ring = nullptr;
+
+  std::lock_guard<std::mutex> lg(mu_);
+
+  auto path = ring_dir_;
+  path += "/qlog-";
+  path += std::to_string(getpid());
+  path += '-';
+  path += std::to_string(qlog_rings_.size());
+  path += ".ring";
+
+  auto ring = std::make_unique<QlogRing>();
+
+  // If the file cannot be created, the qlog of this thread is
+  // dropped.
+  if (ring->open(path, ring_size_) != 0) {
+    return nullptr;
+  }
+
+  tr.ring = ring.get();
+  qlog_rings_.push_back(std::move(ring));
+
+  return tr.ring;
+}
+
+namespace {
+// ring_push appends a record to |ring|.  It returns false if |ring|
+// does not have enough space.
+bool ring_push(QlogSink::Ring *ring, const Record &rec, const void *data,
+               size_t &used) {
+  auto need = sizeof(rec) + rec.len;
+  auto tail = ring->tail.load(std::memory_order_relaxed);
+  auto head = ring->head.load(std::memory_order_acquire);
+
+  if (QlogSink::RING_SIZE - (tail - head) < need) {
+    return false;
+  }
+
+  ring_copy_in(ring->data.get(), tail, &rec, sizeof(rec));
+  if (rec.len) {
+    ring_copy_in(ring->data.get(), tail + sizeof(rec), data, rec.len);
+  }
+
+  ring->tail.store(tail + need, std::memory_order_release);
+
+  used = tail + need - head;
+
+  return true;
+}
+} // namespace
+
+void QlogSink::write(QlogFile *f, const void *data, size_t datalen) {
+  if (!ring_dir_.empty()) {
+    auto ring = get_qlog_ring();
+    if (!ring ||
+        !ring->append(QlogRing::RecordType::DATA, f->id, data, datalen)) {
+      f->ndropped.fetch_add(datalen, std::memory_order_relaxed);
+    }
+
+    return;
+  }
+
+  auto ring = get_ring();
+  size_t used;
+
+  if (datalen > RING_SIZE / 2 ||
+      !ring_push(ring,
+                 Record{
+                     .file = f,
+                     .len = static_cast<uint32_t>(datalen),
+                     .type = RecordType::DATA,
+                 },
+                 data, used)) {
+    f->ndropped.fetch_add(datalen, std::memory_order_relaxed);
+    return;
+  }
+
+  // Wake up the background thread early if the ring is filling up.
+  // Otherwise, it wakes up by itself periodically.
+  if (used > RING_SIZE / 2) {
+    cv_.notify_one();
+  }
+}
+
+void QlogSink::close(QlogFile *f) {
+  if (!ring_dir_.empty()) {
+    if (auto ring = get_qlog_ring(); ring) {
+      ring->append(QlogRing::RecordType::CLOSE, f->id, nullptr, 0);
+    }
+
+    if (auto n = f->ndropped.load(std::memory_order_relaxed); n) {
+      std::cerr << "qlog: " << n << " bytes were dropped from " << f->path
+                << std::endl;
+    }
+
+    delete f;
+
+    return;
+  }
+
+  auto ring = get_ring();
+  size_t used;
+
+  if (ring_push(ring,
+                Record{
+                    .file = f,
+                    .len = 0,
+                    .type = RecordType::CLOSE,
+                },
+                nullptr, used)) {
+    return;
+  }
+
+  // The ring is full.  Closing is not on the packet path, so take the
+  // lock.  run picks closes_ before it drains the rings, so the data
+  // written before this call are flushed first.
+  std::lock_guard<std::mutex> lg(mu_);
+  closes_.push_back(f);
+}
+
+size_t QlogSink::drain(Ring *ring) {
+  auto head = ring->head.load(std::memory_order_relaxed);
+  auto tail = ring->tail.load(std::memory_order_acquire);
+  size_t n = 0;
+
+  while (head != tail) {
+    Record rec;
+
+    ring_copy_out(&rec, ring->data.get(), head, sizeof(rec));
+
+    auto f = rec.file;
+
+    switch (rec.type) {
+    case RecordType::DATA: {
+      auto len = f->buf.size();
+      f->buf.resize(len + rec.len);
+      ring_copy_out(f->buf.data() + len, ring->data.get(), head + sizeof(rec),
+                    rec.len);
+      files.insert(f);
+      if (f->buf.size() >= WRITE_SIZE) {
+        file_flush(f, compress_, /* fin = */ false);
+      }
+      break;
+    }
+    case RecordType::CLOSE:
+      files.erase(f);
+      file_close(f, compress_);
+      break;
+    }
+
+    head += sizeof(rec) + rec.len;
+    n += rec.len;
+
+    // Release the space as soon as possible.
+    ring->head.store(head, std::memory_order_release);
+  }
+
+  return n;
+}
+
+void QlogSink::run() {
+  std::vector<Ring *> rings;
+  std::vector<QlogFile *> closes;
+
+  for (;;) {
+    bool stop;
+
+    {
+      std::unique_lock<std::mutex> lk(mu_);
+      cv_.wait_for(lk, 10ms, [this]() { return stop_; });
+
+      stop = stop_;
+
+      closes.swap(closes_);
+
+      rings.clear();
+      for (auto &r : rings_) {
+        rings.push_back(r.get());
+      }
+    }
+
+    for (auto r : rings) {
+      drain(r);
+    }
+
+    for (auto f : closes) {
+      files.erase(f);
+      file_close(f, compress_);
+    }
+
+    closes.clear();
+
+    if (stop) {
+      break;
+    }
+  }
+
+  // Flush the files whose owner did not close them.
+  for (auto f : files) {
+    file_close(f, compress_);
+  }
+
+  files.clear();
+}
@@ -0,0 +1,127 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef QLOG_SINK_H
+#define QLOG_SINK_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "qlog_ring.h"
+
+class QlogSink;
+
+// QlogFile is a qlog output file which is written by the background
+// thread of QlogSink.  The file is opened lazily by that thread, so
+// that opening it does not block the event loop either.
+struct QlogFile;
+
+// QlogSink moves qlog output off the packet path.  Each thread which
+// writes qlog gets its own single-producer single-consumer ring
+// buffer.  write only copies data into it and never blocks; if the
+// ring is full, the data is dropped and counted.  A background thread
+// drains the rings, accumulates the data of each file, and writes it
+// in large chunks, optionally compressed with gzip.
+//
+// Alternatively, QlogSink writes qlog into a QlogRing per thread,
+// which keeps the latest qlog of all connections in memory shared
+// with an external reader.  In this mode, there is no background
+// thread, and nothing is written unless the reader dumps the rings.
+class QlogSink {
+public:
+  // RING_SIZE is the size of the ring buffer of each thread.
+  static constexpr size_t RING_SIZE = 4 * 1024 * 1024;
+  // WRITE_SIZE is the amount of data of a file which is buffered
+  // before it is written.
+  static constexpr size_t WRITE_SIZE = 256 * 1024;
+
+  QlogSink();
+  ~QlogSink();
+
+  QlogSink(const QlogSink &) = delete;
+  QlogSink &operator=(const QlogSink &) = delete;
+
+  // start starts the background thread.  If |compress| is true, each
+  // file is gzip compressed.  It returns 0 if it succeeds, or -1.
+  int start(bool compress);
+  // start_ring makes this object write qlog into the ring files of
+  // |size| bytes under |dir|, one for each thread which writes qlog.
+  // It returns 0 if it succeeds, or -1.
+  int start_ring(std::string dir, size_t size);
+
+  // open returns QlogFile which writes to |path|.  If compression is
+  // enabled, ".gz" is appended to |path|.  If the rings are used,
+  // only the file name of |path| is recorded in the ring.
+  QlogFile *open(std::string path);
+  // write appends |data| of length |datalen| to |f|.  It is safe to
+  // call from any thread.  A single call is never split, so that a
+  // dropped chunk does not leave a partial qlog record.
+  void write(QlogFile *f, const void *data, size_t datalen);
+  // close closes |f| after all data written to it so far are flushed.
+  // |f| must not be used after this call.
+  void close(QlogFile *f);
+
+  // Ring is the ring buffer of a writer thread.
+  struct Ring;
+
+private:
+  Ring *get_ring();
+  QlogRing *get_qlog_ring();
+  void run();
+  size_t drain(Ring *ring);
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  // rings_ are the rings of all threads which have written qlog.
+  // Guarded by mu_.
+  std::vector<std::unique_ptr<Ring>> rings_;
+  // closes_ are the files whose close record did not fit in the
+  // ring.  Guarded by mu_.
+  std::vector<QlogFile *> closes_;
+  // stop_ is true if the background thread should exit.  Guarded by
+  // mu_.
+  bool stop_;
+  bool compress_;
+  std::thread thread_;
+  // ring_dir_ is the directory where the ring files are created.
+  // It is empty unless start_ring is called.
+  std::string ring_dir_;
+  size_t ring_size_;
+  // qlog_rings_ are the ring files of all threads which have written
+  // qlog.  Guarded by mu_.
+  std::vector<std::unique_ptr<QlogRing>> qlog_rings_;
+  std::atomic<uint64_t> next_id_;
+};
+
+#endif // QLOG_SINK_H
@@ -0,0 +1,841 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// qlogconv converts qlog written in NGTCP2_QLOG_FORMAT_BINARY to
+// qlog in JSON Text Sequences.  The output is the same as the one
+// which the library writes with NGTCP2_QLOG_FORMAT_JSON_SEQ.  See
+// lib/ngtcp2_qlog.h for the binary layout.
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <ngtcp2/ngtcp2.h>
+
+namespace {
+constexpr std::string_view MAGIC = "NGQB";
+constexpr uint64_t VERSION = 1;
+
+// These must match ngtcp2_qlog_bin_event and
+// ngtcp2_qlog_bin_pkt_type in lib/ngtcp2_qlog.h.
+enum Event : uint64_t {
+  EVENT_PKT_SENT = 0x01,
+  EVENT_PKT_RECEIVED = 0x02,
+  EVENT_PARAMETERS_SET = 0x03,
+  EVENT_METRICS_UPDATED = 0x04,
+  EVENT_PKT_LOST = 0x05,
+  EVENT_RETRY_RECEIVED = 0x06,
+  EVENT_STATELESS_RESET_RECEIVED = 0x07,
+  EVENT_VERSION_NEGOTIATION_RECEIVED = 0x08,
+  EVENT_SEND_LIMITED = 0x09,
+  EVENT_PTO_PROBE_SENT = 0x0a,
+};
+
+// Frame types are QUIC frame types.  STREAM frame is always
+// FRAME_STREAM regardless of its flags.
+enum FrameType : uint64_t {
+  FRAME_PADDING = 0x00,
+  FRAME_PING = 0x01,
+  FRAME_ACK = 0x02,
+  FRAME_ACK_ECN = 0x03,
+  FRAME_RESET_STREAM = 0x04,
+  FRAME_STOP_SENDING = 0x05,
+  FRAME_CRYPTO = 0x06,
+  FRAME_NEW_TOKEN = 0x07,
+  FRAME_STREAM = 0x08,
+  FRAME_MAX_DATA = 0x10,
+  FRAME_MAX_STREAM_DATA = 0x11,
+  FRAME_MAX_STREAMS_BIDI = 0x12,
+  FRAME_MAX_STREAMS_UNI = 0x13,
+  FRAME_DATA_BLOCKED = 0x14,
+  FRAME_STREAM_DATA_BLOCKED = 0x15,
+  FRAME_STREAMS_BLOCKED_BIDI = 0x16,
+  FRAME_STREAMS_BLOCKED_UNI = 0x17,
+  FRAME_NEW_CONNECTION_ID = 0x18,
+  FRAME_RETIRE_CONNECTION_ID = 0x19,
+  FRAME_PATH_CHALLENGE = 0x1a,
+  FRAME_PATH_RESPONSE = 0x1b,
+  FRAME_CONNECTION_CLOSE = 0x1c,
+  FRAME_CONNECTION_CLOSE_APP = 0x1d,
+  FRAME_HANDSHAKE_DONE = 0x1e,
+  FRAME_IMMEDIATE_ACK = 0x1f,
+  FRAME_DATAGRAM = 0x30,
+  FRAME_DATAGRAM_LEN = 0x31,
+  FRAME_ACK_FREQUENCY = 0xaf,
+  FRAME_REPAIR = 0xec,
+};
+
+constexpr const char *PKT_TYPES[] = {
+    "initial", "handshake",           "0RTT",            "1RTT",
+    "retry",   "version_negotiation", "stateless_reset", "unknown",
+};
+
+// BBR2_STATES is indexed by ngtcp2_bbr2_state.
+constexpr const char *BBR2_STATES[] = {
+    "unknown",         "startup",         "drain",       "probe_bw_down",
+    "probe_bw_cruise", "probe_bw_refill", "probe_bw_up", "probe_rtt",
+};
+
+// STALL_CAUSES is indexed by ngtcp2_stall_cause.
+constexpr const char *STALL_CAUSES[] = {
+    "none",
+    "cwnd",
+    "pacing",
+    "connection_flow_control",
+    "stream_flow_control",
+    "application",
+};
+
+// PTO_PROBE_POLICIES is indexed by ngtcp2_pto_probe_policy.
+constexpr const char *PTO_PROBE_POLICIES[] = {
+    "new_data_first",
+    "retransmit_oldest",
+    "duplicate_latest",
+};
+} // namespace
+
+namespace {
+// Reader reads the binary fields from a buffer.  Once it runs out of
+// data, every read returns 0 and failed() returns true.
+class Reader {
+public:
+  Reader(const uint8_t *p, size_t len) : p_(p), end_(p + len), failed_(false) {}
+
+  uint64_t varint() {
+    if (p_ == end_) {
+      failed_ = true;
+      return 0;
+    }
+
+    size_t n = 1u << (*p_ >> 6);
+    if (static_cast<size_t>(end_ - p_) < n) {
+      failed_ = true;
+      p_ = end_;
+      return 0;
+    }
+
+    uint64_t v = *p_++ & 0x3f;
+    for (size_t i = 1; i < n; ++i) {
+      v = (v << 8) | *p_++;
+    }
+
+    return v;
+  }
+
+  // bytes returns the next |n| bytes.
+  std::string_view bytes(size_t n) {
+    if (static_cast<size_t>(end_ - p_) < n) {
+      failed_ = true;
+      p_ = end_;
+      return {};
+    }
+
+    auto res = std::string_view{reinterpret_cast<const char *>(p_), n};
+    p_ += n;
+    return res;
+  }
+
+  // lbytes reads varint length followed by the bytes of that length.
+  std::string_view lbytes() { return bytes(varint()); }
+
+  // sub returns Reader of the next |n| bytes, and skips them.
+  Reader sub(size_t n) {
+    auto b = bytes(n);
+    return Reader{reinterpret_cast<const uint8_t *>(b.data()), b.size()};
+  }
+
+  bool eof() const { return p_ == end_; }
+  bool failed() const { return failed_; }
+
+private:
+  const uint8_t *p_;
+  const uint8_t *end_;
+  bool failed_;
+};
+} // namespace
+
+namespace {
+void write_hex(std::string &out, std::string_view s) {
+  constexpr char LOWER_XDIGITS[] = "0123456789abcdef";
+
+  out += '"';
+  for (auto c : s) {
+    auto b = static_cast<uint8_t>(c);
+    out += LOWER_XDIGITS[b >> 4];
+    out += LOWER_XDIGITS[b & 0xf];
+  }
+  out += '"';
+}
+} // namespace
+
+namespace {
+void write_pair_number(std::string &out, std::string_view name, uint64_t n) {
+  out += '"';
+  out += name;
+  out += "\":";
+  out += std::to_string(n);
+}
+} // namespace
+
+namespace {
+void write_pair_duration(std::string &out, std::string_view name,
+                         uint64_t d) {
+  write_pair_number(out, name, d / NGTCP2_MILLISECONDS);
+}
+} // namespace
+
+namespace {
+void write_pair_hex(std::string &out, std::string_view name,
+                    std::string_view s) {
+  out += '"';
+  out += name;
+  out += "\":";
+  write_hex(out, s);
+}
+} // namespace
+
+namespace {
+void write_pair_bool(std::string &out, std::string_view name, bool b) {
+  out += '"';
+  out += name;
+  out += "\":";
+  out += b ? "true" : "false";
+}
+} // namespace
+
+namespace {
+void write_pkt_hd(std::string &out, Reader &r) {
+  auto type = r.varint();
+  auto pkt_num = r.varint();
+  auto token = r.lbytes();
+
+  out += "{\"packet_type\":\"";
+  out += PKT_TYPES[type < std::size(PKT_TYPES) ? type : 7];
+  out += "\",";
+  write_pair_number(out, "packet_number", pkt_num);
+  if (!token.empty()) {
+    out += ",\"token\":{";
+    write_pair_hex(out, "data", token);
+    out += '}';
+  }
+  out += '}';
+}
+} // namespace
+
+namespace {
+void write_ack_frame(std::string &out, Reader &r, bool ecn) {
+  out += "{\"frame_type\":\"ack\",";
+  write_pair_duration(out, "ack_delay", r.varint());
+  out += ",\"acked_ranges\":[";
+
+  auto largest_ack = r.varint();
+  auto min_ack = largest_ack - r.varint();
+  auto num_blks = r.varint();
+
+  auto write_range = [&out](uint64_t min_ack, uint64_t largest_ack) {
+    out += '[';
+    out += std::to_string(min_ack);
+    if (largest_ack != min_ack) {
+      out += ',';
+      out += std::to_string(largest_ack);
+    }
+    out += ']';
+  };
+
+  write_range(min_ack, largest_ack);
+
+  for (uint64_t i = 0; i < num_blks && !r.failed(); ++i) {
+    largest_ack = min_ack - r.varint() - 2;
+    min_ack = largest_ack - r.varint();
+    out += ',';
+    write_range(min_ack, largest_ack);
+  }
+
+  out += ']';
+
+  if (ecn) {
+    out += ',';
+    write_pair_number(out, "ect1", r.varint());
+    out += ',';
+    write_pair_number(out, "ect0", r.varint());
+    out += ',';
+    write_pair_number(out, "ce", r.varint());
+  }
+
+  out += '}';
+}
+} // namespace
+
+namespace {
+// write_frame writes a frame read from |r| to |out|.  It returns
+// false if the frame type is unknown.
+bool write_frame(std::string &out, Reader &r) {
+  auto type = r.varint();
+
+  switch (type) {
+  case FRAME_PADDING:
+    out += "{\"frame_type\":\"padding\"}";
+    return true;
+  case FRAME_PING:
+    out += "{\"frame_type\":\"ping\"}";
+    return true;
+  case FRAME_ACK:
+  case FRAME_ACK_ECN:
+    write_ack_frame(out, r, type == FRAME_ACK_ECN);
+    return true;
+  case FRAME_RESET_STREAM:
+    out += "{\"frame_type\":\"reset_stream\",";
+    write_pair_number(out, "stream_id", r.varint());
+    out += ',';
+    write_pair_number(out, "error_code", r.varint());
+    out += ',';
+    write_pair_number(out, "final_size", r.varint());
+    out += '}';
+    return true;
+  case FRAME_STOP_SENDING:
+    out += "{\"frame_type\":\"stop_sending\",";
+    write_pair_number(out, "stream_id", r.varint());
+    out += ',';
+    write_pair_number(out, "error_code", r.varint());
+    out += '}';
+    return true;
+  case FRAME_CRYPTO:
+    out += "{\"frame_type\":\"crypto\",";
+    write_pair_number(out, "offset", r.varint());
+    out += ',';
+    write_pair_number(out, "length", r.varint());
+    out += '}';
+    return true;
+  case FRAME_NEW_TOKEN: {
+    auto token = r.lbytes();
+    out += "{\"frame_type\":\"new_token\",";
+    write_pair_number(out, "length", token.size());
+    out += ",\"token\":{";
+    write_pair_hex(out, "data", token);
+    out += "}}";
+    return true;
+  }
+  case FRAME_STREAM: {
+    auto fin = r.varint();
+    out += "{\"frame_type\":\"stream\",";
+    write_pair_number(out, "stream_id", r.varint());
+    out += ',';
+    write_pair_number(out, "offset", r.varint());
+    out += ',';
+    write_pair_number(out, "length", r.varint());
+    if (fin) {
+      out += ',';
+      write_pair_bool(out, "fin", true);
+    }
+    out += '}';
+    return true;
+  }
+  case FRAME_MAX_DATA:
+    out += "{\"frame_type\":\"max_data\",";
+    write_pair_number(out, "maximum", r.varint());
+    out += '}';
+    return true;
+  case FRAME_MAX_STREAM_DATA:
+    out += "{\"frame_type\":\"max_stream_data\",";
+    write_pair_number(out, "stream_id", r.varint());
+    out += ',';
+    write_pair_number(out, "maximum", r.varint());
+    out += '}';
+    return true;
+  case FRAME_MAX_STREAMS_BIDI:
+  case FRAME_MAX_STREAMS_UNI:
+    out += "{\"frame_type\":\"max_streams\",\"stream_type\":";
+    out += type == FRAME_MAX_STREAMS_BIDI ? "\"bidirectional\""
+                                                 : "\"unidirectional\"";
+    out += ',';
+    write_pair_number(out, "maximum", r.varint());
+    out += '}';
+    return true;
+  case FRAME_DATA_BLOCKED:
+    out += "{\"frame_type\":\"data_blocked\"}";
+    return true;
+  case FRAME_STREAM_DATA_BLOCKED:
+    out += "{\"frame_type\":\"stream_data_blocked\"}";
+    return true;
+  case FRAME_STREAMS_BLOCKED_BIDI:
+  case FRAME_STREAMS_BLOCKED_UNI:
+    out += "{\"frame_type\":\"streams_blocked\"}";
+    return true;
+  case FRAME_NEW_CONNECTION_ID: {
+    out += "{\"frame_type\":\"new_connection_id\",";
+    write_pair_number(out, "sequence_number", r.varint());
+    out += ',';
+    write_pair_number(out, "retire_prior_to", r.varint());
+    auto cid = r.lbytes();
+    out += ',';
+    write_pair_number(out, "connection_id_length", cid.size());
+    out += ',';
+    write_pair_hex(out, "connection_id", cid);
+    out += ",\"stateless_reset_token\":{";
+    write_pair_hex(out, "data", r.bytes(NGTCP2_STATELESS_RESET_TOKENLEN));
+    out += "}}";
+    return true;
+  }
+  case FRAME_RETIRE_CONNECTION_ID:
+    out += "{\"frame_type\":\"retire_connection_id\",";
+    write_pair_number(out, "sequence_number", r.varint());
+    out += '}';
+    return true;
+  case FRAME_PATH_CHALLENGE:
+    out += "{\"frame_type\":\"path_challenge\",";
+    write_pair_hex(out, "data", r.bytes(8));
+    out += '}';
+    return true;
+  case FRAME_PATH_RESPONSE:
+    out += "{\"frame_type\":\"path_response\",";
+    write_pair_hex(out, "data", r.bytes(8));
+    out += '}';
+    return true;
+  case FRAME_CONNECTION_CLOSE:
+  case FRAME_CONNECTION_CLOSE_APP: {
+    auto error_code = r.varint();
+    out += "{\"frame_type\":\"connection_close\",\"error_space\":";
+    out += type == FRAME_CONNECTION_CLOSE ? "\"transport\""
+                                                 : "\"application\"";
+    out += ',';
+    write_pair_number(out, "error_code", error_code);
+    out += ',';
+    write_pair_number(out, "raw_error_code", error_code);
+    out += '}';
+    return true;
+  }
+  case FRAME_HANDSHAKE_DONE:
+    out += "{\"frame_type\":\"handshake_done\"}";
+    return true;
+  case FRAME_DATAGRAM:
+  case FRAME_DATAGRAM_LEN:
+    out += "{\"frame_type\":\"datagram\",";
+    write_pair_number(out, "length", r.varint());
+    out += '}';
+    return true;
+  case FRAME_ACK_FREQUENCY:
+    out += "{\"frame_type\":\"ack_frequency\",";
+    write_pair_number(out, "sequence_number", r.varint());
+    out += ',';
+    write_pair_number(out, "ack_eliciting_threshold", r.varint());
+    out += ',';
+    write_pair_number(out, "request_max_ack_delay", r.varint());
+    out += ',';
+    write_pair_number(out, "reordering_threshold", r.varint());
+    out += '}';
+    return true;
+  case FRAME_IMMEDIATE_ACK:
+    out += "{\"frame_type\":\"immediate_ack\"}";
+    return true;
+  case FRAME_REPAIR:
+    out += "{\"frame_type\":\"repair\",";
+    write_pair_number(out, "stream_id", r.varint());
+    out += ',';
+    write_pair_number(out, "offset", r.varint());
+    out += ',';
+    write_pair_number(out, "symbol_count", r.varint());
+    out += ',';
+    write_pair_number(out, "length", r.varint());
+    out += '}';
+    return true;
+  default:
+    return false;
+  }
+}
+} // namespace
+
+namespace {
+void write_pkt(std::string &out, Reader &r, bool sent) {
+  out += sent ? "\"transport:packet_sent\"" : "\"transport:packet_received\"";
+  out += ",\"data\":{\"frames\":[";
+
+  auto frames = r.sub(r.varint());
+
+  for (auto first = true; !frames.eof() && !frames.failed(); first = false) {
+    if (!first) {
+      out += ',';
+    }
+    if (!write_frame(out, frames)) {
+      if (!first) {
+        out.pop_back();
+      }
+      break;
+    }
+  }
+
+  out += "],\"header\":";
+  write_pkt_hd(out, r);
+  out += ",\"raw\":{";
+  write_pair_number(out, "length", r.varint());
+  out += "}}";
+}
+} // namespace
+
+namespace {
+void write_parameters_set(std::string &out, Reader &r) {
+  out += "\"transport:parameters_set\",\"data\":{\"owner\":";
+  out += r.varint() == 0 ? "\"local\"" : "\"remote\"";
+
+  auto flags = r.varint();
+
+  out += ',';
+  write_pair_hex(out, "initial_source_connection_id", r.lbytes());
+  out += ',';
+  if (flags & 0x01) {
+    write_pair_hex(out, "original_destination_connection_id", r.lbytes());
+    out += ',';
+  }
+  if (flags & 0x02) {
+    write_pair_hex(out, "retry_source_connection_id", r.lbytes());
+    out += ',';
+  }
+  if (flags & 0x04) {
+    out += "\"stateless_reset_token\":{";
+    write_pair_hex(out, "data", r.bytes(NGTCP2_STATELESS_RESET_TOKENLEN));
+    out += "},";
+  }
+  write_pair_bool(out, "disable_active_migration", flags & 0x10);
+  out += ',';
+  write_pair_duration(out, "max_idle_timeout", r.varint());
+  out += ',';
+  write_pair_number(out, "max_udp_payload_size", r.varint());
+  out += ',';
+  write_pair_number(out, "ack_delay_exponent", r.varint());
+  out += ',';
+  write_pair_duration(out, "max_ack_delay", r.varint());
+  out += ',';
+  write_pair_number(out, "active_connection_id_limit", r.varint());
+  out += ',';
+  write_pair_number(out, "initial_max_data", r.varint());
+  out += ',';
+  write_pair_number(out, "initial_max_stream_data_bidi_local", r.varint());
+  out += ',';
+  write_pair_number(out, "initial_max_stream_data_bidi_remote", r.varint());
+  out += ',';
+  write_pair_number(out, "initial_max_stream_data_uni", r.varint());
+  out += ',';
+  write_pair_number(out, "initial_max_streams_bidi", r.varint());
+  out += ',';
+  write_pair_number(out, "initial_max_streams_uni", r.varint());
+  if (flags & 0x08) {
+    out += ",\"preferred_address\":{";
+    write_pair_hex(out, "ip_v4", r.bytes(4));
+    out += ',';
+    write_pair_number(out, "port_v4", r.varint());
+    out += ',';
+    write_pair_hex(out, "ip_v6", r.bytes(16));
+    out += ',';
+    write_pair_number(out, "port_v6", r.varint());
+    out += ',';
+    write_pair_hex(out, "connection_id", r.lbytes());
+    out += ",\"stateless_reset_token\":{";
+    write_pair_hex(out, "data", r.bytes(NGTCP2_STATELESS_RESET_TOKENLEN));
+    out += "}}";
+  }
+  out += ',';
+  write_pair_number(out, "max_datagram_frame_size", r.varint());
+  out += ',';
+  write_pair_bool(out, "grease_quic_bit", flags & 0x20);
+  out += '}';
+}
+} // namespace
+
+namespace {
+void write_metrics_updated(std::string &out, Reader &r) {
+  out += "\"recovery:metrics_updated\",\"data\":{";
+
+  auto flags = r.varint();
+
+  if (flags & 0x01) {
+    write_pair_duration(out, "min_rtt", r.varint());
+    out += ',';
+  }
+  write_pair_duration(out, "smoothed_rtt", r.varint());
+  out += ',';
+  write_pair_duration(out, "latest_rtt", r.varint());
+  out += ',';
+  write_pair_duration(out, "rtt_variance", r.varint());
+  out += ',';
+  write_pair_number(out, "pto_count", r.varint());
+  out += ',';
+  write_pair_number(out, "congestion_window", r.varint());
+  out += ',';
+  write_pair_number(out, "bytes_in_flight", r.varint());
+  if (flags & 0x02) {
+    out += ',';
+    write_pair_number(out, "ssthresh", r.varint());
+  }
+  if (flags & 0x04) {
+    auto state = r.varint();
+
+    out += ",\"bbr2_state\":\"";
+    out += BBR2_STATES[state < std::size(BBR2_STATES) ? state : 0];
+    out += "\",";
+    write_pair_number(out, "bbr2_max_bw", r.varint());
+    if (flags & 0x08) {
+      out += ',';
+      write_pair_number(out, "bbr2_bw_lo", r.varint());
+    }
+    if (flags & 0x10) {
+      out += ',';
+      write_pair_number(out, "bbr2_inflight_hi", r.varint());
+    }
+    if (flags & 0x20) {
+      out += ',';
+      write_pair_number(out, "bbr2_inflight_lo", r.varint());
+    }
+    out += ',';
+    write_pair_number(out, "bbr2_inflight_too_high_count", r.varint());
+  }
+  out += '}';
+}
+} // namespace
+
+namespace {
+void write_version_negotiation(std::string &out, Reader &r) {
+  out += "\"transport:packet_received\",\"data\":{\"header\":";
+  write_pkt_hd(out, r);
+  out += ",\"supported_versions\":[";
+
+  auto nsv = r.varint();
+  for (uint64_t i = 0; i < nsv && !r.failed(); ++i) {
+    if (i) {
+      out += ',';
+    }
+    write_hex(out, r.bytes(4));
+  }
+
+  out += "]}";
+}
+} // namespace
+
+namespace {
+// write_event writes an event |ev| whose body is |r| to |out|.  It
+// returns false if |ev| is unknown.
+bool write_event(std::string &out, uint64_t ev, uint64_t ts, Reader &r) {
+  out += "\x1e{";
+  write_pair_number(out, "time", ts / NGTCP2_MILLISECONDS);
+  out += ",\"name\":";
+
+  switch (ev) {
+  case EVENT_PKT_SENT:
+  case EVENT_PKT_RECEIVED:
+    write_pkt(out, r, ev == EVENT_PKT_SENT);
+    break;
+  case EVENT_PARAMETERS_SET:
+    write_parameters_set(out, r);
+    break;
+  case EVENT_METRICS_UPDATED:
+    write_metrics_updated(out, r);
+    break;
+  case EVENT_PKT_LOST:
+    out += "\"recovery:packet_lost\",\"data\":{\"header\":";
+    write_pkt_hd(out, r);
+    out += '}';
+    break;
+  case EVENT_SEND_LIMITED: {
+    auto cause = r.varint();
+
+    out += "\"transport:send_limited\",\"data\":{\"cause\":\"";
+    out += STALL_CAUSES[cause < std::size(STALL_CAUSES) ? cause : 0];
+    out += "\"}";
+    break;
+  }
+  case EVENT_PTO_PROBE_SENT: {
+    out += "\"recovery:pto_probe_sent\",\"data\":{";
+    write_pair_number(out, "packet_number", r.varint());
+
+    auto policy = r.varint();
+
+    out += ",\"policy\":\"";
+    out += PTO_PROBE_POLICIES[policy < std::size(PTO_PROBE_POLICIES) ? policy
+                                                                      : 0];
+    out += "\",";
+    write_pair_bool(out, "retransmission", r.varint() != 0);
+    out += '}';
+    break;
+  }
+  case EVENT_RETRY_RECEIVED:
+    out += "\"transport:packet_received\",\"data\":{\"header\":";
+    write_pkt_hd(out, r);
+    out += ",\"retry_token\":{";
+    write_pair_hex(out, "data", r.lbytes());
+    out += "}}";
+    break;
+  case EVENT_STATELESS_RESET_RECEIVED:
+    out += "\"transport:packet_received\",\"data\":{\"header\":";
+    write_pkt_hd(out, r);
+    out += ',';
+    write_pair_hex(out, "stateless_reset_token",
+                   r.bytes(NGTCP2_STATELESS_RESET_TOKENLEN));
+    out += '}';
+    break;
+  case EVENT_VERSION_NEGOTIATION_RECEIVED:
+    write_version_negotiation(out, r);
+    break;
+  default:
+    return false;
+  }
+
+  out += "}\n";
+
+  return true;
+}
+} // namespace
+
+namespace {
+int convert(const std::vector<uint8_t> &in, FILE *fp) {
+  Reader r{in.data(), in.size()};
+  std::string out;
+
+  if (r.bytes(MAGIC.size()) != MAGIC) {
+    std::fprintf(stderr, "qlogconv: not a binary qlog\n");
+    return -1;
+  }
+
+  if (auto v = r.varint(); v != VERSION) {
+    std::fprintf(stderr, "qlogconv: unsupported version %" PRIu64 "\n", v);
+    return -1;
+  }
+
+  auto server = r.varint();
+  auto odcid = r.lbytes();
+
+  if (r.failed()) {
+    std::fprintf(stderr, "qlogconv: truncated preamble\n");
+    return -1;
+  }
+
+  out += "\x1e{\"qlog_format\":\"JSON-SEQ\",\"qlog_version\":\"0.3\","
+         "\"trace\":{\"vantage_point\":{\"name\":\"ngtcp2\",\"type\":";
+  out += server ? "\"server\"" : "\"client\"";
+  out += "},\"common_fields\":{\"protocol_type\":[\"QUIC\"],\"time_format\":"
+         "\"relative\",\"reference_time\":0,\"group_id\":";
+  write_hex(out, odcid);
+  out += "}}}\n";
+
+  uint64_t ts = 0;
+  size_t nskipped = 0;
+
+  while (!r.eof()) {
+    auto ev = r.varint();
+    ts += r.varint();
+    auto body = r.sub(r.varint());
+
+    if (r.failed()) {
+      std::fprintf(stderr, "qlogconv: truncated event\n");
+      break;
+    }
+
+    auto len = out.size();
+
+    if (!write_event(out, ev, ts, body)) {
+      out.resize(len);
+      ++nskipped;
+      continue;
+    }
+
+    if (body.failed()) {
+      std::fprintf(stderr, "qlogconv: malformed event %" PRIu64 "\n", ev);
+      out.resize(len);
+      continue;
+    }
+
+    if (out.size() >= 64 * 1024) {
+      std::fwrite(out.data(), 1, out.size(), fp);
+      out.clear();
+    }
+  }
+
+  std::fwrite(out.data(), 1, out.size(), fp);
+
+  if (nskipped) {
+    std::fprintf(stderr, "qlogconv: skipped %zu unknown events\n", nskipped);
+  }
+
+  return 0;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 3 || (argc > 1 && (std::strcmp(argv[1], "-h") == 0 ||
+                                std::strcmp(argv[1], "--help") == 0))) {
+    std::fprintf(stderr, "Usage: qlogconv [<INPUT> [<OUTPUT>]]\n"
+                         "Convert binary qlog to JSON-SEQ qlog.  <INPUT> "
+                         "and <OUTPUT> default to\nstdin and stdout.\n");
+    return argc > 3 ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+
+  auto in = stdin;
+  if (argc > 1 && std::strcmp(argv[1], "-") != 0) {
+    in = std::fopen(argv[1], "rb");
+    if (!in) {
+      std::fprintf(stderr, "qlogconv: could not open %s: %s\n", argv[1],
+                   std::strerror(errno));
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::vector<uint8_t> data;
+  uint8_t buf[16384];
+
+  for (;;) {
+    auto n = std::fread(buf, 1, sizeof(buf), in);
+    data.insert(std::end(data), buf, buf + n);
+    if (n < sizeof(buf)) {
+      break;
+    }
+  }
+
+  if (in != stdin) {
+    std::fclose(in);
+  }
+
+  auto out = stdout;
+  if (argc > 2 && std::strcmp(argv[2], "-") != 0) {
+    out = std::fopen(argv[2], "wb");
+    if (!out) {
+      std::fprintf(stderr, "qlogconv: could not open %s: %s\n", argv[2],
+                   std::strerror(errno));
+      return EXIT_FAILURE;
+    }
+  }
+
+  auto rv = convert(data, out);
+
+  if (out != stdout) {
+    std::fclose(out);
+  }
+
+  return rv == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,218 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// qlogring dumps the qlog in the ring files which server and client
+// write with --qlog-ring.  The rings are read while the writers keep
+// running, so that the qlog around an incident can be saved without
+// stopping them.  Each qlog file is written to the output directory
+// under the name which the writer gave it.  If the beginning of a
+// qlog has been overwritten in the ring, the name is unknown, and
+// "<RING>-<ID>.qlog" is used instead.
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "qlog_ring.h"
+
+namespace {
+struct Output {
+  std::string name;
+  std::vector<uint8_t> data;
+  // truncated is true if the beginning of the qlog is missing.
+  bool truncated = true;
+};
+} // namespace
+
+namespace {
+// dump writes the qlog in the ring file |path| to |outdir|.  The
+// records older than |since| in nanoseconds since the UNIX epoch are
+// skipped.  It returns 0 if it succeeds, or -1.
+int dump(const char *path, const std::string &outdir, uint64_t since) {
+  auto fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    std::fprintf(stderr, "qlogring: could not open %s: %s\n", path,
+                 std::strerror(errno));
+    return -1;
+  }
+
+  struct stat st;
+
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    std::fprintf(stderr, "qlogring: %s is not a qlog ring\n", path);
+    close(fd);
+    return -1;
+  }
+
+  auto maplen = static_cast<size_t>(st.st_size);
+  auto map = mmap(nullptr, maplen, PROT_READ, MAP_SHARED, fd, 0);
+
+  close(fd);
+
+  if (map == MAP_FAILED) {
+    std::fprintf(stderr, "qlogring: could not map %s: %s\n", path,
+                 std::strerror(errno));
+    return -1;
+  }
+
+  std::vector<QlogRingEntry> entries;
+
+  auto rv =
+      qlog_ring_snapshot(entries, static_cast<const uint8_t *>(map), maplen);
+
+  munmap(map, maplen);
+
+  if (rv != 0) {
+    std::fprintf(stderr, "qlogring: %s is not a qlog ring\n", path);
+    return -1;
+  }
+
+  std::string_view base = path;
+  if (auto pos = base.rfind('/'); pos != std::string_view::npos) {
+    base.remove_prefix(pos + 1);
+  }
+
+  std::map<uint64_t, Output> outputs;
+
+  for (auto &ent : entries) {
+    auto &out = outputs[ent.id];
+
+    switch (ent.type) {
+    case QlogRing::RecordType::OPEN:
+      out.name.assign(std::begin(ent.data), std::end(ent.data));
+      out.truncated = ent.ts < since;
+      break;
+    case QlogRing::RecordType::DATA:
+      if (ent.ts < since) {
+        break;
+      }
+      out.data.insert(std::end(out.data), std::begin(ent.data),
+                      std::end(ent.data));
+      break;
+    case QlogRing::RecordType::CLOSE:
+      break;
+    }
+  }
+
+  for (auto &[id, out] : outputs) {
+    if (out.data.empty()) {
+      continue;
+    }
+
+    auto name = out.name;
+
+    // The name is written by the writer, but do not let it escape
+    // outdir.
+    if (name.empty() || name.find('/') != std::string::npos ||
+        name == "." || name == "..") {
+      name = std::string{base} + '-' + std::to_string(id) + ".qlog";
+    }
+
+    auto outpath = outdir + '/' + name;
+    auto fp = std::fopen(outpath.c_str(), "wb");
+    if (!fp) {
+      std::fprintf(stderr, "qlogring: could not open %s: %s\n",
+                   outpath.c_str(), std::strerror(errno));
+      return -1;
+    }
+
+    std::fwrite(out.data.data(), 1, out.data.size(), fp);
+    std::fclose(fp);
+
+    if (out.truncated) {
+      std::fprintf(stderr, "qlogring: the beginning of %s is missing\n",
+                   outpath.c_str());
+    }
+  }
+
+  return 0;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  uint64_t last = 0;
+  auto argidx = 1;
+  auto help = argc > 1 && (std::strcmp(argv[1], "-h") == 0 ||
+                           std::strcmp(argv[1], "--help") == 0);
+
+  if (argc > 1 && std::strncmp(argv[1], "--last=", 7) == 0) {
+    char *end;
+
+    errno = 0;
+    last = std::strtoull(argv[1] + 7, &end, 10);
+    if (errno || end == argv[1] + 7 || *end != '\0') {
+      std::fprintf(stderr, "qlogring: --last: invalid argument\n");
+      return EXIT_FAILURE;
+    }
+
+    ++argidx;
+  }
+
+  if (help || argc - argidx < 2) {
+    std::fprintf(stderr,
+                 "Usage: qlogring [--last=<SECONDS>] <OUTDIR> <RING>...\n"
+                 "Dump the qlog in the ring files written with --qlog-ring "
+                 "to <OUTDIR>.  If\n--last is given, only the records "
+                 "written in the last <SECONDS> seconds are\ndumped.\n");
+    return help ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  std::string outdir = argv[argidx++];
+  uint64_t since = 0;
+
+  if (last) {
+    auto now = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count());
+    auto window = last * 1'000'000'000ull;
+
+    since = now > window ? now - window : 0;
+  }
+
+  auto rv = EXIT_SUCCESS;
+
+  for (; argidx < argc; ++argidx) {
+    if (dump(argv[argidx], outdir, since) != 0) {
+      rv = EXIT_FAILURE;
+    }
+  }
+
+  return rv;
+}
@@ -0,0 +1,270 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef RESUMPTION_CACHE_H
+#define RESUMPTION_CACHE_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include <ngtcp2/ngtcp2.h>
+
+#include "util.h"
+
+namespace ngtcp2 {
+
+// ResumptionState is what the connections to a server have learned
+// for the next connection to resume with.  An empty field is not
+// known yet.
+struct ResumptionState {
+  // session is the TLS session ticket serialized by the TLS backend.
+  std::string session;
+  // token is the token received in NEW_TOKEN frame.
+  std::string token;
+  // transport_params is the transport parameters of the server for
+  // 0-RTT in the format of ClientBase::write_transport_params.
+  std::string transport_params;
+};
+
+// ResumptionCache remembers ResumptionState per authority, host:port,
+// so that the connections which the load generation workers make
+// after the first ones take the resumed fast path: a session ticket
+// for 0-RTT, a token to skip address validation, and the transport
+// parameters to send 0-RTT data with.  Unlike --session-file,
+// --token-file, and --tp-file, the cache is updated by all
+// connections, and shared by all workers.  The congestion control
+// state is remembered by PathCache.
+//
+// Timestamps are wall-clock nanoseconds so that the entries saved to
+// a file keep aging across runs.
+class ResumptionCache {
+public:
+  explicit ResumptionCache(ngtcp2_duration lifetime = 3600 * NGTCP2_SECONDS,
+                           size_t max_entries = 4096)
+      : lifetime_(lifetime), max_entries_(max_entries) {}
+
+  ResumptionCache(const ResumptionCache &) = delete;
+  ResumptionCache &operator=(const ResumptionCache &) = delete;
+
+  // get returns the state of |authority| if it was updated within the
+  // lifetime before |now|.
+  std::optional<ResumptionState> get(const std::string &authority,
+                                     ngtcp2_tstamp now) const {
+    std::lock_guard<std::mutex> lock(mu_);
+
+    auto it = entries_.find(authority);
+    if (it == std::end(entries_) || expired((*it).second, now)) {
+      return {};
+    }
+
+    return (*it).second.state;
+  }
+
+  // put_session stores the TLS session ticket |session| for
+  // |authority|.
+  void put_session(const std::string &authority, std::string session,
+                   ngtcp2_tstamp now) {
+    std::lock_guard<std::mutex> lock(mu_);
+
+    find_or_insert(authority, now).session = std::move(session);
+  }
+
+  // put_token stores the token |token| received in NEW_TOKEN frame
+  // for |authority|.
+  void put_token(const std::string &authority, std::string token,
+                 ngtcp2_tstamp now) {
+    std::lock_guard<std::mutex> lock(mu_);
+
+    find_or_insert(authority, now).token = std::move(token);
+  }
+
+  // put_transport_params stores the encoded transport parameters
+  // |params| for |authority|.
+  void put_transport_params(const std::string &authority, std::string params,
+                            ngtcp2_tstamp now) {
+    std::lock_guard<std::mutex> lock(mu_);
+
+    find_or_insert(authority, now).transport_params = std::move(params);
+  }
+
+  // load reads the entries written by save from |path|.  It returns 0
+  // if it succeeds, or -1.
+  int load(const char *path) {
+    std::ifstream f(path);
+    if (!f) {
+      return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+
+    std::string k, session, token, params;
+    ngtcp2_tstamp ts;
+
+    while (f >> k >> ts >> session >> token >> params) {
+      auto ent = Entry{{}, ts};
+
+      if (decode_field(ent.state.session, session) != 0 ||
+          decode_field(ent.state.token, token) != 0 ||
+          decode_field(ent.state.transport_params, params) != 0) {
+        return -1;
+      }
+
+      if (auto it = entries_.find(k);
+          it == std::end(entries_) || (*it).second.ts < ts) {
+        make_room(ts);
+        entries_[k] = std::move(ent);
+      }
+    }
+
+    return f.eof() ? 0 : -1;
+  }
+
+  // save writes the entries to |path| one per line: the authority,
+  // the time when the entry was updated, and the hex encoded session
+  // ticket, token, and transport parameters, each of which is "-" if
+  // it is empty.  It returns 0 if it succeeds, or -1.
+  int save(const char *path) const {
+    std::ofstream f(path);
+    if (!f) {
+      return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+
+    for (auto &[k, ent] : entries_) {
+      f << k << ' ' << ent.ts << ' ' << encode_field(ent.state.session) << ' '
+        << encode_field(ent.state.token) << ' '
+        << encode_field(ent.state.transport_params) << '\n';
+    }
+
+    f.close();
+
+    return f ? 0 : -1;
+  }
+
+  // size returns the number of entries including the expired ones.
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mu_);
+
+    return entries_.size();
+  }
+
+private:
+  struct Entry {
+    ResumptionState state;
+    // ts is the time when the entry was updated last.
+    ngtcp2_tstamp ts;
+  };
+
+  bool expired(const Entry &ent, ngtcp2_tstamp now) const {
+    return ent.ts + lifetime_ <= now;
+  }
+
+  static std::string encode_field(const std::string &s) {
+    if (s.empty()) {
+      return "-";
+    }
+
+    return util::format_hex(s);
+  }
+
+  static int decode_field(std::string &dest, const std::string &s) {
+    if (s == "-") {
+      dest.clear();
+      return 0;
+    }
+
+    if (s.size() % 2 ||
+        !std::all_of(std::begin(s), std::end(s), util::is_hex_digit)) {
+      return -1;
+    }
+
+    dest = util::decode_hex(s);
+
+    return 0;
+  }
+
+  // make_room removes the expired entries, and then the oldest one
+  // if the cache is still full.
+  void make_room(ngtcp2_tstamp now) {
+    if (entries_.size() < max_entries_) {
+      return;
+    }
+
+    std::erase_if(entries_,
+                  [this, now](auto &kv) { return expired(kv.second, now); });
+
+    if (entries_.size() < max_entries_) {
+      return;
+    }
+
+    auto oldest = std::begin(entries_);
+
+    for (auto it = std::begin(entries_); it != std::end(entries_); ++it) {
+      if ((*it).second.ts < (*oldest).second.ts) {
+        oldest = it;
+      }
+    }
+
+    entries_.erase(oldest);
+  }
+
+  // find_or_insert returns the state of |authority|, and marks it
+  // updated at |now|.  The expired state is reset.
+  ResumptionState &find_or_insert(const std::string &authority,
+                                  ngtcp2_tstamp now) {
+    if (auto it = entries_.find(authority); it != std::end(entries_)) {
+      auto &ent = (*it).second;
+
+      if (expired(ent, now)) {
+        ent.state = {};
+      }
+
+      ent.ts = std::max(ent.ts, now);
+
+      return ent.state;
+    }
+
+    make_room(now);
+
+    return entries_.emplace(authority, Entry{{}, now}).first->second.state;
+  }
+
+  mutable std::mutex mu_;
+  std::unordered_map<std::string, Entry> entries_;
+  ngtcp2_duration lifetime_;
+  size_t max_entries_;
+};
+
+} // namespace ngtcp2
+
+#endif // RESUMPTION_CACHE_H
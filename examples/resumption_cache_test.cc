@@ -0,0 +1,104 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "resumption_cache_test.h"
+
+#include <unistd.h>
+
+#include <CUnit/CUnit.h>
+
+#include "resumption_cache.h"
+
+namespace ngtcp2 {
+
+void test_resumption_cache_get() {
+  constexpr auto lifetime = 10 * NGTCP2_SECONDS;
+  ResumptionCache cache(lifetime, 2);
+
+  CU_ASSERT(!cache.get("example.com:443", 0));
+
+  cache.put_session("example.com:443", "session", 0);
+  cache.put_token("example.com:443", "token", 1);
+
+  auto res = cache.get("example.com:443", 1);
+
+  CU_ASSERT(res.has_value());
+  CU_ASSERT("session" == res->session);
+  CU_ASSERT("token" == res->token);
+  CU_ASSERT(res->transport_params.empty());
+  CU_ASSERT(!cache.get("example.com:4433", 1));
+
+  // The update extends the lifetime of the entry.
+  CU_ASSERT(cache.get("example.com:443", lifetime).has_value());
+  CU_ASSERT(!cache.get("example.com:443", lifetime + 1));
+
+  // The expired state is not merged into the new one.
+  cache.put_transport_params("example.com:443", "params", lifetime + 1);
+
+  res = cache.get("example.com:443", lifetime + 1);
+
+  CU_ASSERT(res.has_value());
+  CU_ASSERT(res->session.empty());
+  CU_ASSERT(res->token.empty());
+  CU_ASSERT("params" == res->transport_params);
+
+  // The oldest entry is evicted when the cache is full.
+  cache.put_token("a.example:443", "a", lifetime + 2);
+  cache.put_token("b.example:443", "b", lifetime + 3);
+
+  CU_ASSERT(2 == cache.size());
+  CU_ASSERT(!cache.get("example.com:443", lifetime + 3));
+  CU_ASSERT("a" == cache.get("a.example:443", lifetime + 3)->token);
+  CU_ASSERT("b" == cache.get("b.example:443", lifetime + 3)->token);
+}
+
+void test_resumption_cache_save_load() {
+  ResumptionCache cache;
+  char path[] = "/tmp/resumption_cache_test.XXXXXX";
+  auto fd = mkstemp(path);
+
+  CU_ASSERT(fd != -1);
+
+  close(fd);
+
+  cache.put_session("example.com:443", std::string{"\x00\xff\n", 3}, 1000);
+  cache.put_transport_params("example.com:443", "initial_max_data=1\n", 1000);
+
+  CU_ASSERT(0 == cache.save(path));
+
+  ResumptionCache cache2;
+
+  CU_ASSERT(0 == cache2.load(path));
+
+  auto res = cache2.get("example.com:443", 1000);
+
+  CU_ASSERT(res.has_value());
+  CU_ASSERT((std::string{"\x00\xff\n", 3}) == res->session);
+  CU_ASSERT(res->token.empty());
+  CU_ASSERT("initial_max_data=1\n" == res->transport_params);
+
+  unlink(path);
+}
+
+} // namespace ngtcp2
@@ -31,6 +31,8 @@
 #include <memory>
 #include <fstream>
 #include <iomanip>
+#include <thread>
+#include <charconv>
 
 #include <unistd.h>
 #include <getopt.h>
@@ -40,9 +42,21 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <sched.h>
+#include <pthread.h>
 #include <netinet/udp.h>
 #include <net/if.h>
 
+#ifdef HAVE_LIBURING
+#  include <sys/eventfd.h>
+#endif // HAVE_LIBURING
+
+#ifdef HAVE_LIBBPF
+#  include <bpf/libbpf.h>
+#  include <bpf/bpf.h>
+#endif // HAVE_LIBBPF
+
 #include <http-parser/http_parser.h>
 
 #include "server.h"
@@ -52,6 +66,8 @@
 #include "shared.h"
 #include "http.h"
 #include "template.h"
+#include "dyn_pattern.h"
+#include "file_cache.h"
 
 using namespace ngtcp2;
 using namespace std::literals;
@@ -65,23 +81,242 @@ constexpr size_t MAX_DYNBUFLEN = 10 * 1024 * 1024;
 } // namespace
 
 namespace {
-constexpr size_t max_preferred_versionslen = 4;
+// rx_msg_ctrllen is the size of ancillary data buffer for an incoming
+// datagram.  It has room for ECN, packet info, UDP_GRO segment size,
+// and SO_RXQ_OVFL counter.
+constexpr size_t rx_msg_ctrllen =
+    CMSG_SPACE(sizeof(uint8_t)) + CMSG_SPACE(sizeof(in6_pktinfo)) +
+    CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(uint32_t));
+} // namespace
+
+namespace {
+// rx_bufsize is the size of buffer to receive a single UDP datagram.
+// UDP_GRO coalesces datagrams up to this size.
+constexpr size_t rx_bufsize = 64_k;
+// tx_bufsize is the size of buffer to write a single GSO batch.
+constexpr size_t tx_bufsize = 64_k;
+// stateless_reset_burst is the maximum number of Stateless Reset
+// packets which server sends in a burst.
+constexpr size_t stateless_reset_burst = 100;
+// stateless_reset_interval is the interval to add one more Stateless
+// Reset packet to the budget.
+constexpr ngtcp2_duration stateless_reset_interval = 10 * NGTCP2_MILLISECONDS;
+} // namespace
+
+#ifdef HAVE_LIBURING
+namespace {
+// The upper 32 bits of user_data of io_uring submission tell the
+// operation.  The lower 32 bits is the index of Endpoint for receive,
+// and the index of message for send.
+constexpr uint64_t uring_op_recv = 1;
+constexpr uint64_t uring_op_send = 2;
+// uring_nbuf is the number of buffers in the provided buffer ring.
+constexpr unsigned int uring_nbuf = 256;
+// uring_bgid is the ID of the provided buffer ring.
+constexpr int uring_bgid = 0;
+// uring_entries is the number of submission queue entries.
+constexpr unsigned int uring_entries = 1024;
 } // namespace
+#endif // HAVE_LIBURING
 
 namespace {
-auto randgen = util::make_mt19937();
+thread_local auto randgen = util::make_mt19937();
 } // namespace
 
 Config config{};
 
+namespace {
+// qlog_sink writes qlog in the background if --qlog-dir is given.
+QlogSink *qlog_sink;
+} // namespace
+
+#ifdef HAVE_LIBBPF
+namespace {
+// xdp_program is the XDP program attached to the interface if --xdp
+// is given.
+XdpProgram *xdp_program;
+} // namespace
+#endif // HAVE_LIBBPF
+
+#ifdef HAVE_LIBDPDK
+namespace {
+// dpdk_port is the Ethernet port driven by DPDK if --dpdk is given.
+DpdkPort *dpdk_port;
+} // namespace
+#endif // HAVE_LIBDPDK
+
 Stream::Stream(int64_t stream_id, Handler *handler)
     : stream_id(stream_id),
       handler(handler),
       data(nullptr),
       datalen(0),
+      mapped(false),
       dynresp(false),
       dyndataleft(0),
-      dynbuflen(0) {}
+      dynbuflen(0),
+      dynoff(0) {}
+
+namespace {
+void proxyreadcb(struct ev_loop *loop, ev_io *w, int revents) {
+  auto proxy = static_cast<UDPProxy *>(w->data);
+
+  proxy->on_read();
+}
+} // namespace
+
+UDPProxy::UDPProxy(struct ev_loop *loop, Stream *stream, int fd)
+    : loop(loop),
+      stream(stream),
+      fd(fd),
+      headerlen(http::write_http_datagram_header(header.data(),
+                                                 stream->stream_id, 0)),
+      tx{},
+      rx{} {
+  rx.data = std::make_unique<uint8_t[]>(udp_proxy_nslot * udp_proxy_slotsize);
+
+  ev_io_init(&rev, proxyreadcb, fd, EV_READ);
+  rev.data = this;
+  ev_io_start(loop, &rev);
+}
+
+UDPProxy::~UDPProxy() {
+  auto h = stream->handler;
+
+  if (tx.queued) {
+    h->server()->remove_proxy_tx(this);
+  }
+
+  if (rx.queued) {
+    h->remove_proxy_rx(this);
+  }
+
+  ev_io_stop(loop, &rev);
+  close(fd);
+}
+
+void UDPProxy::on_read() {
+#ifdef HAVE_RECVMMSG
+  std::array<mmsghdr, udp_proxy_nslot> msgs;
+  std::array<iovec, udp_proxy_nslot> iovs;
+
+  for (;;) {
+    auto nfree = udp_proxy_nslot - rx.len;
+    if (nfree == 0) {
+      // The datagrams wait in the socket buffer until write_streams
+      // frees the slots.
+      ev_io_stop(loop, &rev);
+      break;
+    }
+
+    for (size_t i = 0; i < nfree; ++i) {
+      auto slot = (rx.head + rx.len + i) % udp_proxy_nslot;
+
+      iovs[i].iov_base = rx.data.get() + slot * udp_proxy_slotsize;
+      iovs[i].iov_len = udp_proxy_slotsize;
+
+      msgs[i] = mmsghdr{};
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int nmsg;
+
+    do {
+      nmsg = recvmmsg(fd, msgs.data(), nfree, 0, nullptr);
+    } while (nmsg == -1 && errno == EINTR);
+
+    if (nmsg == -1) {
+      if (errno != EAGAIN && !config.quiet) {
+        std::cerr << "recvmmsg: " << strerror(errno) << std::endl;
+      }
+      break;
+    }
+
+    for (size_t i = 0; i < static_cast<size_t>(nmsg); ++i) {
+      // A datagram which does not fit in a slot is dropped.
+      if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+        continue;
+      }
+
+      auto slot = (rx.head + rx.len) % udp_proxy_nslot;
+      auto dest = rx.data.get() + slot * udp_proxy_slotsize;
+
+      // The following datagrams move up to fill the slot of the
+      // dropped one.
+      if (dest != iovs[i].iov_base) {
+        memmove(dest, iovs[i].iov_base, msgs[i].msg_len);
+      }
+
+      rx.lens[slot] = msgs[i].msg_len;
+      ++rx.len;
+    }
+
+    if (static_cast<size_t>(nmsg) < nfree) {
+      break;
+    }
+  }
+
+  if (rx.len) {
+    stream->handler->queue_proxy_rx(this);
+  }
+#endif // HAVE_RECVMMSG
+}
+
+void UDPProxy::queue_tx(const uint8_t *data, size_t datalen) {
+  tx.iovs.push_back(iovec{const_cast<uint8_t *>(data), datalen});
+}
+
+void UDPProxy::flush_tx() {
+#ifdef HAVE_SENDMMSG
+  std::array<mmsghdr, 64> msgs;
+
+  for (size_t i = 0; i < tx.iovs.size();) {
+    auto n = std::min(msgs.size(), tx.iovs.size() - i);
+
+    for (size_t j = 0; j < n; ++j) {
+      msgs[j] = mmsghdr{};
+      msgs[j].msg_hdr.msg_iov = &tx.iovs[i + j];
+      msgs[j].msg_hdr.msg_iovlen = 1;
+    }
+
+    int nsent;
+
+    do {
+      nsent = sendmmsg(fd, msgs.data(), n, 0);
+    } while (nsent == -1 && errno == EINTR);
+
+    if (nsent == -1) {
+      // Like the network, UDP proxy drops the datagrams which the
+      // socket cannot take now.
+      if (errno != EAGAIN && !config.quiet) {
+        std::cerr << "sendmmsg: " << strerror(errno) << std::endl;
+      }
+      break;
+    }
+
+    i += nsent;
+  }
+#endif // HAVE_SENDMMSG
+
+  tx.iovs.clear();
+}
+
+ngtcp2_vec UDPProxy::rx_front() {
+  assert(rx.len);
+
+  return {rx.data.get() + rx.head * udp_proxy_slotsize, rx.lens[rx.head]};
+}
+
+void UDPProxy::pop_rx() {
+  assert(rx.len);
+
+  if (rx.len == udp_proxy_nslot) {
+    ev_io_start(loop, &rev);
+  }
+
+  rx.head = (rx.head + 1) % udp_proxy_nslot;
+  --rx.len;
+}
 
 namespace {
 constexpr char NGTCP2_SERVER[] = "nghttp3/ngtcp2 server";
@@ -198,62 +433,130 @@ Request request_path(const std::string_view &uri, bool is_connect) {
 }
 } // namespace
 
-enum FileEntryFlag {
-  FILE_ENTRY_TYPE_DIR = 0x1,
-};
+namespace {
+FileCache &get_file_cache() {
+  static FileCache file_cache(config.file_cache_size);
 
-struct FileEntry {
-  uint64_t len;
-  void *map;
-  int fd;
-  uint8_t flags;
-};
+  return file_cache;
+}
+} // namespace
+
+namespace {
+MetricsRegistry &get_metrics_registry() {
+  static MetricsRegistry metrics_registry;
+
+  return metrics_registry;
+}
+} // namespace
+
+namespace {
+DynPattern &get_dyn_pattern() {
+  static DynPattern dyn_pattern;
+
+  return dyn_pattern;
+}
+} // namespace
 
 namespace {
-std::unordered_map<std::string, FileEntry> file_cache;
+// make_etag returns an entity tag which changes when the file is
+// modified.
+std::string make_etag(const struct stat &st) {
+  std::array<char, 2 * 16 + 3> buf;
+  auto p = buf.data();
+  auto end = p + buf.size();
+
+  *p++ = '"';
+  p = std::to_chars(p, end, static_cast<uint64_t>(st.st_mtime), 16).ptr;
+  *p++ = '-';
+  p = std::to_chars(p, end, static_cast<uint64_t>(st.st_size), 16).ptr;
+  *p++ = '"';
+
+  return {buf.data(), p};
+}
 } // namespace
 
-std::pair<FileEntry, int> Stream::open_file(const std::string &path) {
-  auto it = file_cache.find(path);
-  if (it != std::end(file_cache)) {
-    return {(*it).second, 0};
+std::shared_ptr<FileEntry> Stream::open_file(const std::string &path) {
+  auto &file_cache = get_file_cache();
+
+  if (auto fe = file_cache.find(path); fe) {
+    return fe;
   }
 
   auto fd = open(path.c_str(), O_RDONLY);
   if (fd == -1) {
-    return {{}, -1};
+    return nullptr;
   }
 
   struct stat st {};
   if (fstat(fd, &st) != 0) {
     close(fd);
-    return {{}, -1};
+    return nullptr;
   }
 
-  FileEntry fe{};
+  auto fe = std::make_shared<FileEntry>();
   if (st.st_mode & S_IFDIR) {
-    fe.flags |= FILE_ENTRY_TYPE_DIR;
-    fe.fd = -1;
+    fe->flags |= FILE_ENTRY_TYPE_DIR;
     close(fd);
   } else {
-    fe.fd = fd;
-    fe.len = st.st_size;
-    fe.map = mmap(nullptr, fe.len, PROT_READ, MAP_SHARED, fd, 0);
-    if (fe.map == MAP_FAILED) {
-      std::cerr << "mmap: " << strerror(errno) << std::endl;
-      close(fd);
-      return {{}, -1};
+    fe->len = st.st_size;
+    if (fe->len) {
+      fe->map = mmap(nullptr, fe->len, PROT_READ, MAP_SHARED, fd, 0);
+      if (fe->map == MAP_FAILED) {
+        std::cerr << "mmap: " << strerror(errno) << std::endl;
+        close(fd);
+        return nullptr;
+      }
     }
-  }
 
-  file_cache.emplace(path, fe);
+    // The mapping stays valid after the file is closed.
+    close(fd);
+
+    if (config.file_extent && fe->len) {
+      // The kernel reads ahead aggressively, and drops pages behind.
+      madvise(fe->map, fe->len, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+      // Large files may be backed by huge pages in the page cache if
+      // the kernel supports it.  This is just a hint.
+      if (fe->len >= 2_m) {
+        madvise(fe->map, fe->len, MADV_HUGEPAGE);
+      }
+#endif // defined(MADV_HUGEPAGE)
+    }
+
+    fe->etag = make_etag(st);
+    fe->content_length = util::format_uint(fe->len);
+    fe->content_type = "text/plain";
+
+    auto ext = std::end(path) - 1;
+    for (; ext != std::begin(path) && *ext != '.' && *ext != '/'; --ext)
+      ;
+    if (*ext == '.') {
+      ++ext;
+      auto it = config.mime_types.find(std::string{ext, std::end(path)});
+      if (it != std::end(config.mime_types)) {
+        fe->content_type = (*it).second;
+      }
+    }
+
+    fe->nva = {
+        util::make_nv(":status", "200"),
+        util::make_nv("server", NGTCP2_SERVER),
+        util::make_nv("content-type", fe->content_type),
+        util::make_nv("content-length", fe->content_length),
+        util::make_nv("etag", fe->etag),
+    };
+    fe->nvlen = fe->nva.size();
+  }
 
-  return {std::move(fe), 0};
+  return file_cache.insert(path, std::move(fe));
 }
 
 void Stream::map_file(const FileEntry &fe) {
-  data = static_cast<uint8_t *>(fe.map);
-  datalen = fe.len;
+  if (fe.map != MAP_FAILED) {
+    data = static_cast<uint8_t *>(fe.map);
+    datalen = fe.len;
+  }
+  mapped = true;
 }
 
 int64_t Stream::find_dyn_length(const std::string_view &path) {
@@ -282,17 +585,54 @@ int64_t Stream::find_dyn_length(const std::string_view &path) {
   return static_cast<int64_t>(n);
 }
 
+namespace {
+// prefetch asks the kernel to read the pages of [data, data + len) of
+// a file mapping in the background.
+void prefetch(const uint8_t *data, size_t len) {
+  static const auto pagesize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+
+  auto first = reinterpret_cast<uintptr_t>(data) & ~(pagesize - 1);
+  auto last = reinterpret_cast<uintptr_t>(data) + len;
+
+  madvise(reinterpret_cast<void *>(first), last - first, MADV_WILLNEED);
+}
+} // namespace
+
 namespace {
 nghttp3_ssize read_data(nghttp3_conn *conn, int64_t stream_id, nghttp3_vec *vec,
                         size_t veccnt, uint32_t *pflags, void *user_data,
                         void *stream_user_data) {
   auto stream = static_cast<Stream *>(stream_user_data);
+  auto len = stream->datalen;
+
+  if (stream->mapped && config.file_extent) {
+    len = std::min(len, static_cast<uint64_t>(config.file_extent));
+
+    auto &st = stream->handler->server()->file_stats();
+    ++st.nextent;
+    st.nbytes += len;
+
+    // The pages of the next extent are read while this extent is
+    // sent, so that the encryption does not stall on cold pages.
+    if (len < stream->datalen) {
+      prefetch(stream->data + len,
+               std::min(stream->datalen - len,
+                        static_cast<uint64_t>(config.file_extent)));
+      ++st.nprefetch;
+    }
+  }
 
   vec[0].base = stream->data;
-  vec[0].len = stream->datalen;
-  *pflags |= NGHTTP3_DATA_FLAG_EOF;
-  if (config.send_trailers) {
-    *pflags |= NGHTTP3_DATA_FLAG_NO_END_STREAM;
+  vec[0].len = len;
+
+  stream->data += len;
+  stream->datalen -= len;
+
+  if (stream->datalen == 0) {
+    *pflags |= NGHTTP3_DATA_FLAG_EOF;
+    if (config.send_trailers) {
+      *pflags |= NGHTTP3_DATA_FLAG_NO_END_STREAM;
+    }
   }
 
   return 1;
@@ -314,7 +654,19 @@ nghttp3_ssize dyn_read_data(nghttp3_conn *conn, int64_t stream_id,
   auto len =
       std::min(dyn_buf->size(), static_cast<size_t>(stream->dyndataleft));
 
-  vec[0].base = dyn_buf->data();
+  if (config.dyn_pattern) {
+    static_assert(DynPattern::MAX_CHUNK >= 16_k);
+
+    // The chunk points into the shared pattern, so that streams do
+    // not alias the same 16KiB buffer, and the content can be
+    // verified by the client.
+    vec[0].base = const_cast<uint8_t *>(get_dyn_pattern().data()) +
+                  stream->dynoff;
+    stream->dynoff = (stream->dynoff + len) % DynPattern::PERIOD;
+  } else {
+    vec[0].base = dyn_buf->data();
+  }
+
   vec[0].len = len;
 
   stream->dynbuflen += len;
@@ -322,15 +674,24 @@ nghttp3_ssize dyn_read_data(nghttp3_conn *conn, int64_t stream_id,
 
   if (stream->dyndataleft == 0) {
     *pflags |= NGHTTP3_DATA_FLAG_EOF;
-    if (config.send_trailers) {
+    if (config.send_trailers || !stream->dyn_checksum.empty()) {
       *pflags |= NGHTTP3_DATA_FLAG_NO_END_STREAM;
       auto stream_id_str = util::format_uint(stream_id);
-      std::array<nghttp3_nv, 1> trailers{
-          util::make_nv("x-ngtcp2-stream-id", stream_id_str),
-      };
+      std::array<nghttp3_nv, 2> trailers;
+      size_t ntrailers = 0;
+
+      if (config.send_trailers) {
+        trailers[ntrailers++] =
+            util::make_nv("x-ngtcp2-stream-id", stream_id_str);
+      }
+
+      if (!stream->dyn_checksum.empty()) {
+        trailers[ntrailers++] =
+            util::make_nv("x-ngtcp2-checksum", stream->dyn_checksum);
+      }
 
-      if (auto rv = nghttp3_conn_submit_trailers(
-              conn, stream_id, trailers.data(), trailers.size());
+      if (auto rv = nghttp3_conn_submit_trailers(conn, stream_id,
+                                                 trailers.data(), ntrailers);
           rv != 0) {
         std::cerr << "nghttp3_conn_submit_trailers: " << nghttp3_strerror(rv)
                   << std::endl;
@@ -361,14 +722,15 @@ int Stream::send_status_response(nghttp3_conn *httpconn,
   auto status_code_str = util::format_uint(status_code);
   auto content_length_str = util::format_uint(status_resp_body.size());
 
-  std::vector<nghttp3_nv> nva(4 + extra_headers.size());
+  std::vector<nghttp3_nv> nva(5 + extra_headers.size());
   nva[0] = util::make_nv(":status", status_code_str);
   nva[1] = util::make_nv("server", NGTCP2_SERVER);
   nva[2] = util::make_nv("content-type", "text/html; charset=utf-8");
   nva[3] = util::make_nv("content-length", content_length_str);
+  nva[4] = util::make_nv("date", handler->server()->http_date());
   for (size_t i = 0; i < extra_headers.size(); ++i) {
     auto &hdr = extra_headers[i];
-    auto &nv = nva[4 + i];
+    auto &nv = nva[5 + i];
     nv = util::make_nv(hdr.name, hdr.value);
   }
 
@@ -412,12 +774,125 @@ int Stream::send_redirect_response(nghttp3_conn *httpconn,
   return send_status_response(httpconn, status_code, {{"location", path}});
 }
 
+namespace {
+nghttp3_ssize connect_udp_read_data(nghttp3_conn *conn, int64_t stream_id,
+                                    nghttp3_vec *vec, size_t veccnt,
+                                    uint32_t *pflags, void *user_data,
+                                    void *stream_user_data) {
+  auto stream = static_cast<Stream *>(stream_user_data);
+
+  // The response body is empty.  It ends when the tunnel is closed.
+  if (stream->udp_proxy) {
+    return NGHTTP3_ERR_WOULDBLOCK;
+  }
+
+  *pflags |= NGHTTP3_DATA_FLAG_EOF;
+
+  return 0;
+}
+} // namespace
+
+int Stream::start_connect_udp(nghttp3_conn *httpconn) {
+  if (!config.connect_udp || protocol != "connect-udp") {
+    return send_status_response(httpconn, 501);
+  }
+
+  auto target = http::parse_connect_udp_path(uri);
+  if (!target) {
+    return send_status_response(httpconn, 400);
+  }
+
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_flags = AI_NUMERICSERV;
+
+  addrinfo *res;
+
+  // The name resolution blocks the event loop.  It is acceptable for
+  // the proxy which is used for testing.
+  if (auto rv = getaddrinfo(target->host.c_str(), target->port.c_str(), &hints,
+                            &res);
+      rv != 0) {
+    if (!config.quiet) {
+      std::cerr << "getaddrinfo: " << gai_strerror(rv) << std::endl;
+    }
+    return send_status_response(httpconn, 502);
+  }
+
+  auto fd = -1;
+
+  for (auto rp = res; rp; rp = rp->ai_next) {
+    fd = util::create_nonblock_socket(rp->ai_family, rp->ai_socktype,
+                                      rp->ai_protocol);
+    if (fd == -1) {
+      continue;
+    }
+
+    if (connect(fd, rp->ai_addr, rp->ai_addrlen) == 0) {
+      break;
+    }
+
+    close(fd);
+    fd = -1;
+  }
+
+  freeaddrinfo(res);
+
+  if (fd == -1) {
+    return send_status_response(httpconn, 502);
+  }
+
+  udp_proxy = std::make_unique<UDPProxy>(handler->loop(), this, fd);
+
+  auto nva = std::array<nghttp3_nv, 4>{
+      util::make_nv(":status", "200"),
+      util::make_nv("server", NGTCP2_SERVER),
+      util::make_nv("capsule-protocol", "?1"),
+      util::make_nv("date", handler->server()->http_date()),
+  };
+
+  nghttp3_data_reader dr{};
+  dr.read_data = connect_udp_read_data;
+
+  if (auto rv = nghttp3_conn_submit_response(httpconn, stream_id, nva.data(),
+                                             nva.size(), &dr);
+      rv != 0) {
+    std::cerr << "nghttp3_conn_submit_response: " << nghttp3_strerror(rv)
+              << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int Stream::close_connect_udp(nghttp3_conn *httpconn) {
+  if (!udp_proxy) {
+    return 0;
+  }
+
+  udp_proxy.reset();
+
+  if (auto rv = nghttp3_conn_resume_stream(httpconn, stream_id); rv != 0) {
+    std::cerr << "nghttp3_conn_resume_stream: " << nghttp3_strerror(rv)
+              << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
 int Stream::start_response(nghttp3_conn *httpconn) {
   // TODO This should be handled by nghttp3
   if (uri.empty() || method.empty()) {
     return send_status_response(httpconn, 400);
   }
 
+  // Extended CONNECT (RFC 9220) carries :protocol.
+  if (!protocol.empty()) {
+    return start_connect_udp(httpconn);
+  }
+
   auto req = request_path(uri, method == "CONNECT");
   if (req.path.empty()) {
     return send_status_response(httpconn, 400);
@@ -425,65 +900,93 @@ int Stream::start_response(nghttp3_conn *httpconn) {
 
   auto dyn_len = find_dyn_length(req.path);
 
-  int64_t content_length = -1;
   nghttp3_data_reader dr{};
-  std::string content_type = "text/plain";
+  std::array<nghttp3_nv, 8> nva;
+  size_t nvlen;
+  std::string dyn_content_length, content_length, content_range;
 
   if (dyn_len == -1) {
     auto path = config.htdocs + req.path;
-    auto [fe, rv] = open_file(path);
-    if (rv != 0) {
+    auto fe = open_file(path);
+    if (!fe) {
       send_status_response(httpconn, 404);
       return 0;
     }
 
-    if (fe.flags & FILE_ENTRY_TYPE_DIR) {
+    if (fe->flags & FILE_ENTRY_TYPE_DIR) {
       send_redirect_response(httpconn, 308,
                              path.substr(config.htdocs.size() - 1) + '/');
       return 0;
     }
 
-    content_length = fe.len;
+    // A single range of a file is served, so that client can fetch
+    // the segments of a large file over the concurrent streams.
+    // The malformed or unsatisfiable range is ignored.
+    std::optional<http::ByteRange> byte_range;
+    if (method == "GET" && !range.empty()) {
+      byte_range = http::parse_range(range, fe->len);
+    }
 
-    if (method != "HEAD") {
-      map_file(fe);
+    uint64_t range_len = 0;
+
+    if (byte_range) {
+      range_len = byte_range->last - byte_range->first + 1;
+      content_range = "bytes " + util::format_uint(byte_range->first) + '-' +
+                      util::format_uint(byte_range->last) + '/' +
+                      fe->content_length;
+      content_length = util::format_uint(range_len);
+
+      nva[0] = util::make_nv(":status", "206");
+      nva[1] = util::make_nv("server", NGTCP2_SERVER);
+      nva[2] = util::make_nv("content-type", fe->content_type);
+      nva[3] = util::make_nv("content-length", content_length);
+      nva[4] = util::make_nv("etag", fe->etag);
+      nva[5] = util::make_nv("content-range", content_range);
+      nvlen = 6;
+    } else {
+      nvlen = fe->nvlen;
+      std::copy_n(std::begin(fe->nva), nvlen, std::begin(nva));
     }
 
     dr.read_data = read_data;
 
-    auto ext = std::end(req.path) - 1;
-    for (; ext != std::begin(req.path) && *ext != '.' && *ext != '/'; --ext)
-      ;
-    if (*ext == '.') {
-      ++ext;
-      auto it = config.mime_types.find(std::string{ext, std::end(req.path)});
-      if (it != std::end(config.mime_types)) {
-        content_type = (*it).second;
+    if (method != "HEAD") {
+      map_file(*fe);
+
+      if (byte_range) {
+        data += byte_range->first;
+        datalen = range_len;
       }
     }
+
+    // The header fields and the mapping are used after fe is evicted
+    // from the cache.
+    file = std::move(fe);
   } else {
-    content_length = dyn_len;
+    dyn_content_length = util::format_uint(dyn_len);
     dynresp = true;
     dr.read_data = dyn_read_data;
 
     if (method != "HEAD") {
       datalen = dyn_len;
       dyndataleft = dyn_len;
-    }
 
-    content_type = "application/octet-stream";
-  }
+      if (config.dyn_pattern) {
+        dynoff = DynPattern::start_offset(stream_id);
 
-  auto content_length_str = util::format_uint(content_length);
+        dyn_checksum =
+            format_dyn_checksum(get_dyn_pattern().checksum(dynoff, dyn_len));
+      }
+    }
 
-  std::array<nghttp3_nv, 5> nva{
-      util::make_nv(":status", "200"),
-      util::make_nv("server", NGTCP2_SERVER),
-      util::make_nv("content-type", content_type),
-      util::make_nv("content-length", content_length_str),
-  };
+    nva[0] = util::make_nv(":status", "200");
+    nva[1] = util::make_nv("server", NGTCP2_SERVER);
+    nva[2] = util::make_nv("content-type", "application/octet-stream");
+    nva[3] = util::make_nv("content-length", dyn_content_length);
+    nvlen = 4;
+  }
 
-  size_t nvlen = 4;
+  nva[nvlen++] = util::make_nv("date", handler->server()->http_date());
 
   std::string prival;
 
@@ -558,7 +1061,9 @@ void writecb(struct ev_loop *loop, ev_io *w, int revents) {
 
   switch (h->on_write()) {
   case 0:
+    return;
   case NETWORK_ERR_CLOSE_WAIT:
+    s->add_tombstone(h);
     return;
   default:
     s->remove(h);
@@ -567,41 +1072,16 @@ void writecb(struct ev_loop *loop, ev_io *w, int revents) {
 } // namespace
 
 namespace {
-void close_waitcb(struct ev_loop *loop, ev_timer *w, int revents) {
-  auto h = static_cast<Handler *>(w->data);
-  auto s = h->server();
-  auto conn = h->conn();
+// handle_timeout handles the expiry of the timer of |h|.  If it
+// fails, |h| is removed.  If |h| has entered the closing or draining
+// period, it is replaced with a tombstone.
+int handle_timeout(Handler *h) {
+  int rv;
 
-  if (ngtcp2_conn_is_in_closing_period(conn)) {
-    if (!config.quiet) {
-      std::cerr << "Closing Period is over" << std::endl;
-    }
+  auto s = h->server();
 
-    s->remove(h);
-    return;
-  }
-  if (ngtcp2_conn_is_in_draining_period(conn)) {
-    if (!config.quiet) {
-      std::cerr << "Draining Period is over" << std::endl;
-    }
-
-    s->remove(h);
-    return;
-  }
-
-  assert(0);
-}
-} // namespace
-
-namespace {
-void timeoutcb(struct ev_loop *loop, ev_timer *w, int revents) {
-  int rv;
-
-  auto h = static_cast<Handler *>(w->data);
-  auto s = h->server();
-
-  if (!config.quiet) {
-    std::cerr << "Timer expired" << std::endl;
+  if (!config.quiet) {
+    std::cerr << "Timer expired" << std::endl;
   }
 
   rv = h->handle_expiry();
@@ -614,20 +1094,26 @@ void timeoutcb(struct ev_loop *loop, ev_timer *w, int revents) {
     goto fail;
   }
 
-  return;
+  return 0;
 
 fail:
   switch (rv) {
   case NETWORK_ERR_CLOSE_WAIT:
-    ev_timer_stop(loop, w);
-    return;
+    s->add_tombstone(h);
+    return rv;
   default:
     s->remove(h);
-    return;
+    return rv;
   }
 }
 } // namespace
 
+namespace {
+void timeoutcb(struct ev_loop *loop, ev_timer *w, int revents) {
+  handle_timeout(static_cast<Handler *>(w->data));
+}
+} // namespace
+
 Handler::Handler(struct ev_loop *loop, Server *server)
     : loop_(loop),
       server_(server),
@@ -635,6 +1121,7 @@ Handler::Handler(struct ev_loop *loop, Server *server)
       scid_{},
       httpconn_{nullptr},
       nkey_update_(0),
+      last_token_ts_(0),
       no_gso_{
 #ifdef UDP_SEGMENT
           false
@@ -642,13 +1129,19 @@ Handler::Handler(struct ev_loop *loop, Server *server)
           true
 #endif // !UDP_SEGMENT
       },
-      tx_{
-          .data = std::unique_ptr<uint8_t[]>(new uint8_t[64_k]),
-      } {
+      half_open_(false),
+      start_ts_(util::timestamp(loop)),
+      bdp_(0),
+      rxbuf_{},
+      tx_{} {
+  server_->metrics().connections.add(1);
   ev_io_init(&wev_, writecb, 0, EV_WRITE);
   wev_.data = this;
   ev_timer_init(&timer_, timeoutcb, 0., 0.);
   timer_.data = this;
+  TimerWheel::init_entry(&wheel_entry_, this);
+  TimerWheel::init_entry(&keep_alive_entry_, this);
+  ngtcp2_crypto_aead_ctx_pool_init(&aead_ctx_pool_);
 }
 
 Handler::~Handler() {
@@ -656,16 +1149,67 @@ Handler::~Handler() {
     std::cerr << scid_ << " Closing QUIC connection " << std::endl;
   }
 
+  if (half_open_) {
+    server_->remove_half_open();
+  }
+
+  for (auto &t : reset_tokens_) {
+    server_->dissociate_reset_token(t.data(), this);
+  }
+
+  if (tx_.queued) {
+    // Do not leave a dangling reference to tx_.data in the transmit
+    // queue.
+    server_->flush_tx();
+  }
+
+  if (tx_.data) {
+    server_->release_txbuf(std::move(tx_.data));
+  }
+
   ev_timer_stop(loop_, &timer_);
   ev_io_stop(loop_, &wev_);
 
+  if (config.timer_wheel) {
+    server_->cancel_timer(&wheel_entry_);
+  }
+
+  if (config.keep_alive_timeout) {
+    server_->cancel_keep_alive(this);
+  }
+
   if (httpconn_) {
     nghttp3_conn_del(httpconn_);
   }
 
   if (qlog_) {
-    fclose(qlog_);
+    qlog_sink->close(qlog_);
+  }
+
+  auto &metrics = server_->metrics();
+
+  metrics.connections.add(-1);
+
+  if (bdp_) {
+    server_->add_bdp(-static_cast<int64_t>(bdp_));
+  }
+
+  // Delete conn_ here rather than in ~HandlerBase, so that
+  // delete_crypto_aead_ctx can still return the contexts to
+  // aead_ctx_pool_.
+  if (conn_) {
+    ngtcp2_conn_stat cstat;
+    ngtcp2_stall_stat sstat;
+
+    ngtcp2_conn_get_conn_stat(conn_, &cstat);
+    ngtcp2_conn_get_stall_stat(conn_, &sstat);
+    metrics.on_conn_close(cstat, sstat);
+
+    ngtcp2_conn_del(conn_);
+    conn_ = nullptr;
   }
+
+  ngtcp2_crypto_aead_ctx_pool_free(&aead_ctx_pool_);
 }
 
 namespace {
@@ -684,7 +1228,24 @@ int handshake_completed(ngtcp2_conn *conn, void *user_data) {
 }
 } // namespace
 
+void Handler::set_half_open() {
+  assert(!half_open_);
+
+  half_open_ = true;
+  server_->add_half_open();
+}
+
 int Handler::handshake_completed() {
+  if (half_open_) {
+    half_open_ = false;
+    server_->remove_half_open();
+  }
+
+  auto &metrics = server_->metrics();
+
+  metrics.handshakes.add();
+  metrics.handshake_latency.observe(util::timestamp(loop_) - start_ts_);
+
   if (!config.quiet) {
     std::cerr << "Negotiated cipher suite is " << tls_session_.get_cipher_name()
               << std::endl;
@@ -696,16 +1257,43 @@ int Handler::handshake_completed() {
     std::cerr << "Unable to send session ticket" << std::endl;
   }
 
-  std::array<uint8_t, NGTCP2_CRYPTO_MAX_REGULAR_TOKENLEN> token;
+  if (config.keep_alive_timeout) {
+    ngtcp2_conn_set_keep_alive_timeout(conn_, config.keep_alive_timeout);
+    ngtcp2_conn_set_keep_alive_external(conn_, 1);
+    server_->schedule_keep_alive(this);
+    server_->update_keep_alive_timer();
+  }
+
+  if (start_deferred_responses() != 0) {
+    return -1;
+  }
+
+  return submit_new_token();
+}
+
+int Handler::submit_new_token() {
+  std::array<uint8_t, NGTCP2_MAX_CC_RESUME_PARAMSLEN> data;
+  size_t datalen = 0;
+  ngtcp2_cc_resume_params params;
+
+  ngtcp2_conn_get_cc_resume_params(conn_, &params);
+  if (params.cwnd) {
+    auto nwrite =
+        ngtcp2_encode_cc_resume_params(data.data(), data.size(), &params);
+    assert(nwrite > 0);
+    datalen = static_cast<size_t>(nwrite);
+  }
+
+  std::array<uint8_t, NGTCP2_CRYPTO_MAX_REGULAR_TOKEN2LEN> token;
 
   auto path = ngtcp2_conn_get_path(conn_);
   auto t = std::chrono::duration_cast<std::chrono::nanoseconds>(
                std::chrono::system_clock::now().time_since_epoch())
                .count();
 
-  auto tokenlen = ngtcp2_crypto_generate_regular_token(
-      token.data(), config.static_secret.data(), config.static_secret.size(),
-      path->remote.addr, path->remote.addrlen, t);
+  auto tokenlen = ngtcp2_crypto_token_ctx_generate_regular_token2(
+      server_->token_ctx(), token.data(), path->remote.addr,
+      path->remote.addrlen, data.data(), datalen, t);
   if (tokenlen < 0) {
     if (!config.quiet) {
       std::cerr << "Unable to generate token" << std::endl;
@@ -722,6 +1310,8 @@ int Handler::handshake_completed() {
     return -1;
   }
 
+  last_token_ts_ = util::timestamp(loop_);
+
   return 0;
 }
 
@@ -740,6 +1330,26 @@ int do_hp_mask(uint8_t *dest, const ngtcp2_crypto_cipher *hp,
 }
 } // namespace
 
+namespace {
+int do_hp_mask_batch(uint8_t *dest, const ngtcp2_crypto_cipher *hp,
+                     const ngtcp2_crypto_cipher_ctx *hp_ctx,
+                     const uint8_t *const *samples, size_t nsamples) {
+  if (ngtcp2_crypto_hp_mask_batch_cb(dest, hp, hp_ctx, samples, nsamples) !=
+      0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  if (!config.quiet && config.show_secret) {
+    for (size_t i = 0; i < nsamples; ++i) {
+      debug::print_hp_mask(dest + i * NGTCP2_HP_SAMPLELEN, NGTCP2_HP_MASKLEN,
+                           samples[i], NGTCP2_HP_SAMPLELEN);
+    }
+  }
+
+  return 0;
+}
+} // namespace
+
 namespace {
 int recv_crypto_data(ngtcp2_conn *conn, ngtcp2_crypto_level crypto_level,
                      uint64_t offset, const uint8_t *data, size_t datalen,
@@ -767,6 +1377,17 @@ int recv_stream_data(ngtcp2_conn *conn, uint32_t flags, int64_t stream_id,
 }
 } // namespace
 
+namespace {
+int recv_datagram(ngtcp2_conn *conn, uint32_t flags, const uint8_t *data,
+                  size_t datalen, void *user_data) {
+  auto h = static_cast<Handler *>(user_data);
+
+  h->recv_datagram(data, datalen);
+
+  return 0;
+}
+} // namespace
+
 namespace {
 int acked_stream_data_offset(ngtcp2_conn *conn, int64_t stream_id,
                              uint64_t offset, uint64_t datalen, void *user_data,
@@ -890,7 +1511,9 @@ void rand(uint8_t *dest, size_t destlen, const ngtcp2_rand_ctx *rand_ctx) {
 namespace {
 int get_new_connection_id(ngtcp2_conn *conn, ngtcp2_cid *cid, uint8_t *token,
                           size_t cidlen, void *user_data) {
-  if (util::generate_secure_random(cid->data, cidlen) != 0) {
+  auto h = static_cast<Handler *>(user_data);
+
+  if (h->server()->generate_cid(cid->data, cidlen) != 0) {
     return NGTCP2_ERR_CALLBACK_FAILURE;
   }
 
@@ -901,7 +1524,6 @@ int get_new_connection_id(ngtcp2_conn *conn, ngtcp2_cid *cid, uint8_t *token,
     return NGTCP2_ERR_CALLBACK_FAILURE;
   }
 
-  auto h = static_cast<Handler *>(user_data);
   h->server()->associate_cid(cid, h);
 
   return 0;
@@ -917,6 +1539,16 @@ int remove_connection_id(ngtcp2_conn *conn, const ngtcp2_cid *cid,
 }
 } // namespace
 
+namespace {
+int dcid_status(ngtcp2_conn *conn, int type, uint64_t seq,
+                const ngtcp2_cid *cid, const uint8_t *token,
+                void *user_data) {
+  auto h = static_cast<Handler *>(user_data);
+  h->dcid_status(type, token);
+  return 0;
+}
+} // namespace
+
 namespace {
 int update_key(ngtcp2_conn *conn, uint8_t *rx_secret, uint8_t *tx_secret,
                ngtcp2_crypto_aead_ctx *rx_aead_ctx, uint8_t *rx_iv,
@@ -934,6 +1566,14 @@ int update_key(ngtcp2_conn *conn, uint8_t *rx_secret, uint8_t *tx_secret,
 }
 } // namespace
 
+namespace {
+void delete_crypto_aead_ctx(ngtcp2_conn *conn, ngtcp2_crypto_aead_ctx *aead_ctx,
+                            void *user_data) {
+  auto h = static_cast<Handler *>(user_data);
+  h->release_aead_ctx(aead_ctx);
+}
+} // namespace
+
 namespace {
 int path_validation(ngtcp2_conn *conn, uint32_t flags, const ngtcp2_path *path,
                     ngtcp2_path_validation_result res, void *user_data) {
@@ -1040,6 +1680,13 @@ void Handler::http_recv_request_header(Stream *stream, int32_t token,
   case NGHTTP3_QPACK_TOKEN__AUTHORITY:
     stream->authority = std::string{v.base, v.base + v.len};
     break;
+  case NGHTTP3_QPACK_TOKEN__PROTOCOL:
+    stream->protocol = std::string{v.base, v.base + v.len};
+    break;
+  default:
+    if (util::streq_l("range", nghttp3_rcbuf_get_buf(name))) {
+      stream->range = std::string{v.base, v.base + v.len};
+    }
   }
 }
 
@@ -1060,6 +1707,12 @@ int http_end_request_headers(nghttp3_conn *conn, int64_t stream_id, int fin,
 } // namespace
 
 int Handler::http_end_request_headers(Stream *stream) {
+  // The tunnel is opened without waiting for the end of the request
+  // stream which lasts as long as the tunnel.
+  if (!stream->protocol.empty()) {
+    return start_response(stream);
+  }
+
   if (config.early_response) {
     if (start_response(stream) != 0) {
       return -1;
@@ -1083,6 +1736,11 @@ int http_end_stream(nghttp3_conn *conn, int64_t stream_id, void *user_data,
 } // namespace
 
 int Handler::http_end_stream(Stream *stream) {
+  if (!stream->protocol.empty()) {
+    // Client has closed the tunnel.
+    return stream->close_connect_udp(httpconn_);
+  }
+
   if (!config.early_response) {
     return start_response(stream);
   }
@@ -1090,9 +1748,50 @@ int Handler::http_end_stream(Stream *stream) {
 }
 
 int Handler::start_response(Stream *stream) {
+  // Server cannot read 1RTT packet before the handshake completes, so
+  // that the whole request has been received in 0-RTT.
+  if (!ngtcp2_conn_get_handshake_completed(conn_)) {
+    auto &st = server_->early_data_stats();
+
+    if (http::is_safe_method(stream->method)) {
+      ++st.nsafe;
+    } else {
+      switch (config.unsafe_early_request) {
+      case EarlyRequestPolicy::ACCEPT:
+        ++st.nunsafe;
+        break;
+      case EarlyRequestPolicy::DEFER:
+        ++st.ndeferred;
+        deferred_streams_.push_back(stream->stream_id);
+        return 0;
+      case EarlyRequestPolicy::REJECT:
+        ++st.nrejected;
+        return stream->send_status_response(httpconn_, 425);
+      }
+    }
+  }
+
   return stream->start_response(httpconn_);
 }
 
+int Handler::start_deferred_responses() {
+  for (auto stream_id : deferred_streams_) {
+    // The stream might have been reset by client in the meantime.
+    auto it = streams_.find(stream_id);
+    if (it == std::end(streams_)) {
+      continue;
+    }
+
+    if (it->second->start_response(httpconn_) != 0) {
+      return -1;
+    }
+  }
+
+  deferred_streams_.clear();
+
+  return 0;
+}
+
 namespace {
 int http_acked_stream_data(nghttp3_conn *conn, int64_t stream_id,
                            uint64_t datalen, void *user_data,
@@ -1222,6 +1921,10 @@ int Handler::setup_httpconn() {
   nghttp3_settings_default(&settings);
   settings.qpack_max_dtable_capacity = 4096;
   settings.qpack_blocked_streams = 100;
+  if (config.connect_udp) {
+    settings.enable_connect_protocol = 1;
+    settings.h3_datagram = 1;
+  }
 
   auto mem = nghttp3_mem_default();
 
@@ -1339,13 +2042,14 @@ void write_qlog(void *user_data, uint32_t flags, const void *data,
 
 void Handler::write_qlog(const void *data, size_t datalen) {
   assert(qlog_);
-  fwrite(data, 1, datalen, qlog_);
+  qlog_sink->write(qlog_, data, datalen);
 }
 
 int Handler::init(const Endpoint &ep, const Address &local_addr,
                   const sockaddr *sa, socklen_t salen, const ngtcp2_cid *dcid,
                   const ngtcp2_cid *scid, const ngtcp2_cid *ocid,
-                  const uint8_t *token, size_t tokenlen, uint32_t version,
+                  const uint8_t *token, size_t tokenlen,
+                  const ngtcp2_cc_resume_params &cc_resume, uint32_t version,
                   TLSServerContext &tls_ctx) {
   auto callbacks = ngtcp2_callbacks{
       nullptr, // client_initial
@@ -1374,12 +2078,12 @@ int Handler::init(const Endpoint &ep, const Address &local_addr,
       ::extend_max_remote_streams_bidi,
       nullptr, // extend_max_remote_streams_uni
       ::extend_max_stream_data,
-      nullptr, // dcid_status
+      ::dcid_status,
       nullptr, // handshake_confirmed
       nullptr, // recv_new_token
-      ngtcp2_crypto_delete_crypto_aead_ctx_cb,
+      ::delete_crypto_aead_ctx,
       ngtcp2_crypto_delete_crypto_cipher_ctx_cb,
-      nullptr, // recv_datagram
+      ::recv_datagram,
       nullptr, // ack_datagram
       nullptr, // lost_datagram
       ngtcp2_crypto_get_path_challenge_data_cb,
@@ -1387,43 +2091,71 @@ int Handler::init(const Endpoint &ep, const Address &local_addr,
       ngtcp2_crypto_version_negotiation_cb,
       nullptr, // recv_rx_key
       ::recv_tx_key,
+      ngtcp2_crypto_encrypt_batch_cb,
+      do_hp_mask_batch,
   };
 
+#ifdef WITH_EXAMPLE_PICOTLS
+  // do_hp_mask prints each mask with --show-secret; keep using it then.
+  if (config.quiet || !config.show_secret) {
+    callbacks.encrypt_hp_mask = ngtcp2_crypto_picotls_encrypt_hp_mask_cb;
+  }
+#endif // WITH_EXAMPLE_PICOTLS
+
   scid_.datalen = NGTCP2_SV_SCIDLEN;
-  if (util::generate_secure_random(scid_.data, scid_.datalen) != 0) {
+  if (server_->generate_cid(scid_.data, scid_.datalen) != 0) {
     std::cerr << "Could not generate connection ID" << std::endl;
     return -1;
   }
 
   ngtcp2_settings settings;
   ngtcp2_settings_default(&settings);
-  settings.log_printf = config.quiet ? nullptr : debug::log_printf;
+  settings.log_record = config.quiet ? nullptr : debug::log_record;
   settings.initial_ts = util::timestamp(loop_);
   settings.token = ngtcp2_vec{const_cast<uint8_t *>(token), tokenlen};
+  settings.cc_resume = cc_resume;
   settings.cc_algo = config.cc_algo;
   settings.initial_rtt = config.initial_rtt;
   settings.max_window = config.max_window;
   settings.max_stream_window = config.max_stream_window;
   settings.handshake_timeout = config.handshake_timeout;
   settings.no_pmtud = config.no_pmtud;
+  settings.spin_bit = config.spin_bit;
+  settings.pto_probe_policy = config.pto_probe_policy;
+  settings.pmtud_search = config.pmtud_search;
+  settings.fast_nat_rebinding = config.fast_nat_rebinding;
   settings.ack_thresh = config.ack_thresh;
+  settings.pacing_horizon = config.txtime;
+  // Received datagrams live in the receive buffers of Server which we
+  // do not read again after ngtcp2_conn_read_pkt returns.
+  settings.decrypt_in_place = 1;
+  auto &tp_template = server_->transport_params_template();
+  settings.transport_params_template = &tp_template;
   if (config.max_udp_payload_size) {
     settings.max_udp_payload_size = config.max_udp_payload_size;
-    settings.no_udp_payload_size_shaping = 1;
+    settings.no_udp_payload_size_shaping = !config.pmtud_search;
   }
   if (!config.qlog_dir.empty()) {
     auto path = std::string{config.qlog_dir};
     path += '/';
     path += util::format_hex(scid_.data, scid_.datalen);
-    path += ".sqlog";
-    qlog_ = fopen(path.c_str(), "w");
-    if (qlog_ == nullptr) {
-      std::cerr << "Could not open qlog file " << std::quoted(path) << ": "
-                << strerror(errno) << std::endl;
-      return -1;
-    }
+    path += config.qlog_binary ? ".bqlog" : ".sqlog";
+    qlog_ = qlog_sink->open(std::move(path));
     settings.qlog.write = ::write_qlog;
     settings.qlog.odcid = *scid;
+    if (config.qlog_binary) {
+      settings.qlog.format = NGTCP2_QLOG_FORMAT_BINARY;
+    }
+  }
+  if (!config.trace_dir.empty()) {
+    auto path = std::string{config.trace_dir};
+    path += '/';
+    path += util::format_hex(scid_.data, scid_.datalen);
+    path += ".pkttrace";
+    trace_ = std::make_unique<PktTrace>();
+    if (trace_->open(path) != 0) {
+      trace_.reset();
+    }
   }
   if (!config.preferred_versions.empty()) {
     settings.preferred_versions = config.preferred_versions.data();
@@ -1446,6 +2178,9 @@ int Handler::init(const Endpoint &ep, const Address &local_addr,
   params.max_idle_timeout = config.timeout;
   params.stateless_reset_token_present = 1;
   params.active_connection_id_limit = 7;
+  if (config.connect_udp) {
+    params.max_datagram_frame_size = 65535;
+  }
 
   if (ocid) {
     params.original_dcid = *ocid;
@@ -1455,43 +2190,48 @@ int Handler::init(const Endpoint &ep, const Address &local_addr,
     params.original_dcid = *scid;
   }
 
-  if (util::generate_secure_random(params.stateless_reset_token,
-                                   sizeof(params.stateless_reset_token)) != 0) {
+  if (ngtcp2_crypto_generate_stateless_reset_token(
+          params.stateless_reset_token, config.static_secret.data(),
+          config.static_secret.size(), &scid_) != 0) {
     std::cerr << "Could not generate stateless reset token" << std::endl;
     return -1;
   }
 
-  if (config.preferred_ipv4_addr.len || config.preferred_ipv6_addr.len) {
+  const auto &preferred_ipv4_addr = server_->preferred_ipv4_addr();
+  const auto &preferred_ipv6_addr = server_->preferred_ipv6_addr();
+
+  if (preferred_ipv4_addr.len || preferred_ipv6_addr.len) {
     params.preferred_address_present = 1;
-    if (config.preferred_ipv4_addr.len) {
+    if (preferred_ipv4_addr.len) {
       auto &dest = params.preferred_address.ipv4_addr;
-      const auto &addr = config.preferred_ipv4_addr;
+      const auto &addr = preferred_ipv4_addr;
       assert(sizeof(dest) == sizeof(addr.su.in.sin_addr));
       memcpy(&dest, &addr.su.in.sin_addr, sizeof(dest));
       params.preferred_address.ipv4_port = htons(addr.su.in.sin_port);
       params.preferred_address.ipv4_present = 1;
     }
-    if (config.preferred_ipv6_addr.len) {
+    if (preferred_ipv6_addr.len) {
       auto &dest = params.preferred_address.ipv6_addr;
-      const auto &addr = config.preferred_ipv6_addr;
+      const auto &addr = preferred_ipv6_addr;
       assert(sizeof(dest) == sizeof(addr.su.in6.sin6_addr));
       memcpy(&dest, &addr.su.in6.sin6_addr, sizeof(dest));
       params.preferred_address.ipv6_port = htons(addr.su.in6.sin6_port);
       params.preferred_address.ipv6_present = 1;
     }
 
-    auto &token = params.preferred_address.stateless_reset_token;
-    if (util::generate_secure_random(token, sizeof(token)) != 0) {
-      std::cerr << "Could not generate preferred address stateless reset token"
+    params.preferred_address.cid.datalen = NGTCP2_SV_SCIDLEN;
+    if (server_->generate_cid(params.preferred_address.cid.data,
+                              params.preferred_address.cid.datalen) != 0) {
+      std::cerr << "Could not generate preferred address connection ID"
                 << std::endl;
       return -1;
     }
 
-    params.preferred_address.cid.datalen = NGTCP2_SV_SCIDLEN;
-    if (util::generate_secure_random(params.preferred_address.cid.data,
-                                     params.preferred_address.cid.datalen) !=
-        0) {
-      std::cerr << "Could not generate preferred address connection ID"
+    if (ngtcp2_crypto_generate_stateless_reset_token(
+            params.preferred_address.stateless_reset_token,
+            config.static_secret.data(), config.static_secret.size(),
+            &params.preferred_address.cid) != 0) {
+      std::cerr << "Could not generate preferred address stateless reset token"
                 << std::endl;
       return -1;
     }
@@ -1516,6 +2256,13 @@ int Handler::init(const Endpoint &ep, const Address &local_addr,
     return -1;
   }
 
+  // The transport parameters other than the connection IDs and
+  // tokens only depend on config.  Encode them once per server.
+  if (tp_template.datalen == 0) {
+    ngtcp2_transport_params_template_init(
+        &tp_template, ngtcp2_conn_get_local_transport_params(conn_));
+  }
+
   if (tls_session_.init(tls_ctx, this) != 0) {
     return -1;
   }
@@ -1532,7 +2279,7 @@ int Handler::init(const Endpoint &ep, const Address &local_addr,
 int Handler::feed_data(const Endpoint &ep, const Address &local_addr,
                        const sockaddr *sa, socklen_t salen,
                        const ngtcp2_pkt_info *pi, uint8_t *data,
-                       size_t datalen) {
+                       size_t datalen, size_t gso_size) {
   auto path = ngtcp2_path{
       {
           const_cast<sockaddr *>(&local_addr.su.sa),
@@ -1544,11 +2291,22 @@ int Handler::feed_data(const Endpoint &ep, const Address &local_addr,
       },
       const_cast<Endpoint *>(&ep),
   };
+  auto ts = util::timestamp(loop_);
 
-  if (auto rv = ngtcp2_conn_read_pkt(conn_, &path, pi, data, datalen,
-                                     util::timestamp(loop_));
-      rv != 0) {
-    std::cerr << "ngtcp2_conn_read_pkt: " << ngtcp2_strerror(rv) << std::endl;
+  if (trace_ && trace_->started()) {
+    trace_->write_recv(&path, pi->ecn, data, datalen, gso_size, ts);
+  }
+
+  rxbuf_.begin = data;
+  rxbuf_.end = data + datalen;
+
+  auto rv =
+      ngtcp2_conn_read_pkts(conn_, &path, pi, data, datalen, gso_size, ts);
+
+  rxbuf_ = {};
+
+  if (rv != 0) {
+    std::cerr << "ngtcp2_conn_read_pkts: " << ngtcp2_strerror(rv) << std::endl;
     switch (rv) {
     case NGTCP2_ERR_DRAINING:
       start_draining_period();
@@ -1572,13 +2330,23 @@ int Handler::feed_data(const Endpoint &ep, const Address &local_addr,
     return handle_error();
   }
 
+  if (trace_ && !trace_->started() &&
+      ngtcp2_conn_get_handshake_completed(conn_)) {
+    // This fails until nothing is in flight.  Keep trying until it
+    // succeeds.
+    trace_->start(conn_, &path, tls_session_.get_cipher_name(),
+                  config.cc_algo, ts);
+  }
+
   return 0;
 }
 
 int Handler::on_read(const Endpoint &ep, const Address &local_addr,
                      const sockaddr *sa, socklen_t salen,
-                     const ngtcp2_pkt_info *pi, uint8_t *data, size_t datalen) {
-  if (auto rv = feed_data(ep, local_addr, sa, salen, pi, data, datalen);
+                     const ngtcp2_pkt_info *pi, uint8_t *data, size_t datalen,
+                     size_t gso_size) {
+  if (auto rv =
+          feed_data(ep, local_addr, sa, salen, pi, data, datalen, gso_size);
       rv != 0) {
     return rv;
   }
@@ -1590,6 +2358,11 @@ int Handler::on_read(const Endpoint &ep, const Address &local_addr,
 
 int Handler::handle_expiry() {
   auto now = util::timestamp(loop_);
+
+  if (trace_ && trace_->started()) {
+    trace_->write_expiry(now);
+  }
+
   if (auto rv = ngtcp2_conn_handle_expiry(conn_, now); rv != 0) {
     std::cerr << "ngtcp2_conn_handle_expiry: " << ngtcp2_strerror(rv)
               << std::endl;
@@ -1607,6 +2380,11 @@ int Handler::on_write() {
     return 0;
   }
 
+  if (tx_.queued) {
+    // tx_.data is still referenced by the transmit queue.
+    server_->flush_tx();
+  }
+
   if (tx_.send_blocked) {
     if (auto rv = send_blocked_packet(); rv != 0) {
       return rv;
@@ -1617,15 +2395,39 @@ int Handler::on_write() {
     }
   }
 
-  if (auto rv = write_streams(); rv != 0) {
+  tx_.writing = true;
+
+  auto rv = write_streams();
+
+  tx_.writing = false;
+
+  release_txbuf();
+
+  if (rv != 0) {
     return rv;
   }
 
   update_timer();
 
+  if (config.sock_buf_max) {
+    update_bdp();
+  }
+
   return 0;
 }
 
+void Handler::update_bdp() {
+  ngtcp2_conn_stat cstat;
+
+  ngtcp2_conn_get_conn_stat(conn_, &cstat);
+
+  // The congestion window bounds the bytes in flight, and approximates
+  // the bandwidth-delay product of the path.
+  server_->add_bdp(static_cast<int64_t>(cstat.cwnd) -
+                   static_cast<int64_t>(bdp_));
+  bdp_ = cstat.cwnd;
+}
+
 int Handler::write_streams() {
   std::array<nghttp3_vec, 16> vec;
   ngtcp2_path_storage ps, prev_ps;
@@ -1635,12 +2437,20 @@ int Handler::write_streams() {
   auto path_max_udp_payload_size =
       ngtcp2_conn_get_path_max_udp_payload_size(conn_);
   size_t max_pktcnt =
-      std::min(static_cast<size_t>(64_k), ngtcp2_conn_get_send_quantum(conn_)) /
+      std::min(tx_bufsize, ngtcp2_conn_get_send_quantum(conn_)) /
       max_udp_payload_size;
+
+  if (!tx_.data) {
+    tx_.data = server_->acquire_txbuf();
+  }
+
   uint8_t *bufpos = tx_.data.get();
   ngtcp2_pkt_info pi;
   size_t gso_size = 0;
   auto ts = util::timestamp(loop_);
+  // txtime is the earliest departure time of this batch which is
+  // handed to the kernel with SCM_TXTIME.
+  uint64_t txtime = 0;
 
   ngtcp2_path_storage_zero(&ps);
   ngtcp2_path_storage_zero(&prev_ps);
@@ -1654,47 +2464,110 @@ int Handler::write_streams() {
   }
 
   for (;;) {
-    int64_t stream_id = -1;
-    int fin = 0;
-    nghttp3_ssize sveccnt = 0;
-
-    if (httpconn_ && ngtcp2_conn_get_max_data_left(conn_)) {
-      sveccnt = nghttp3_conn_writev_stream(httpconn_, &stream_id, &fin,
-                                           vec.data(), vec.size());
-      if (sveccnt < 0) {
-        std::cerr << "nghttp3_conn_writev_stream: " << nghttp3_strerror(sveccnt)
-                  << std::endl;
-        ngtcp2_connection_close_error_set_application_error(
-            &last_error_, nghttp3_err_infer_quic_app_error_code(sveccnt),
-            nullptr, 0);
+    ngtcp2_ssize nwrite;
+
+    if (!proxy_rxq_.empty()) {
+      // The datagrams from the targets of CONNECT-UDP tunnels take
+      // precedence over the stream data.
+      auto proxy = proxy_rxq_.front();
+      auto payload = proxy->rx_front();
+      auto datav = std::array<ngtcp2_vec, 2>{
+          ngtcp2_vec{proxy->header.data(), proxy->headerlen},
+          payload,
+      };
+      int accepted;
+
+      nwrite = ngtcp2_conn_writev_datagram(
+          conn_, &ps.path, &pi, bufpos, max_udp_payload_size, &accepted,
+          NGTCP2_WRITE_DATAGRAM_FLAG_MORE, 0, datav.data(), datav.size(), ts);
+      if (nwrite < 0) {
+        switch (nwrite) {
+        case NGTCP2_ERR_WRITE_MORE:
+          assert(accepted);
+          pop_proxy_rx(proxy);
+          continue;
+        case NGTCP2_ERR_INVALID_STATE:
+        case NGTCP2_ERR_INVALID_ARGUMENT:
+          // Client does not accept DATAGRAM frame, or the datagram is
+          // too large for it.  It is dropped.
+          pop_proxy_rx(proxy);
+          continue;
+        }
+
+        std::cerr << "ngtcp2_conn_writev_datagram: "
+                  << ngtcp2_strerror(nwrite) << std::endl;
+        ngtcp2_connection_close_error_set_transport_error_liberr(
+            &last_error_, nwrite, nullptr, 0);
         return handle_error();
       }
-    }
 
-    ngtcp2_ssize ndatalen;
-    auto v = vec.data();
-    auto vcnt = static_cast<size_t>(sveccnt);
+      if (accepted) {
+        pop_proxy_rx(proxy);
+      }
+    } else {
+      int64_t stream_id = -1;
+      int fin = 0;
+      nghttp3_ssize sveccnt = 0;
+
+      if (httpconn_ && ngtcp2_conn_get_max_data_left(conn_)) {
+        sveccnt = nghttp3_conn_writev_stream(httpconn_, &stream_id, &fin,
+                                             vec.data(), vec.size());
+        if (sveccnt < 0) {
+          std::cerr << "nghttp3_conn_writev_stream: "
+                    << nghttp3_strerror(sveccnt) << std::endl;
+          ngtcp2_connection_close_error_set_application_error(
+              &last_error_, nghttp3_err_infer_quic_app_error_code(sveccnt),
+              nullptr, 0);
+          return handle_error();
+        }
+      }
 
-    uint32_t flags = NGTCP2_WRITE_STREAM_FLAG_MORE;
-    if (fin) {
-      flags |= NGTCP2_WRITE_STREAM_FLAG_FIN;
-    }
+      ngtcp2_ssize ndatalen;
+      auto v = vec.data();
+      auto vcnt = static_cast<size_t>(sveccnt);
+
+      uint32_t flags = NGTCP2_WRITE_STREAM_FLAG_MORE;
+      if (fin) {
+        flags |= NGTCP2_WRITE_STREAM_FLAG_FIN;
+      }
+
+      nwrite = ngtcp2_conn_writev_stream(
+          conn_, &ps.path, &pi, bufpos, max_udp_payload_size, &ndatalen,
+          flags, stream_id, reinterpret_cast<const ngtcp2_vec *>(v), vcnt,
+          ts);
+      if (nwrite < 0) {
+        switch (nwrite) {
+        case NGTCP2_ERR_STREAM_DATA_BLOCKED:
+          assert(ndatalen == -1);
+          nghttp3_conn_block_stream(httpconn_, stream_id);
+          continue;
+        case NGTCP2_ERR_STREAM_SHUT_WR:
+          assert(ndatalen == -1);
+          nghttp3_conn_shutdown_stream_write(httpconn_, stream_id);
+          continue;
+        case NGTCP2_ERR_WRITE_MORE:
+          assert(ndatalen >= 0);
+          if (auto rv = nghttp3_conn_add_write_offset(httpconn_, stream_id,
+                                                      ndatalen);
+              rv != 0) {
+            std::cerr << "nghttp3_conn_add_write_offset: "
+                      << nghttp3_strerror(rv) << std::endl;
+            ngtcp2_connection_close_error_set_application_error(
+                &last_error_, nghttp3_err_infer_quic_app_error_code(rv),
+                nullptr, 0);
+            return handle_error();
+          }
+          continue;
+        }
 
-    auto nwrite = ngtcp2_conn_writev_stream(
-        conn_, &ps.path, &pi, bufpos, max_udp_payload_size, &ndatalen, flags,
-        stream_id, reinterpret_cast<const ngtcp2_vec *>(v), vcnt, ts);
-    if (nwrite < 0) {
-      switch (nwrite) {
-      case NGTCP2_ERR_STREAM_DATA_BLOCKED:
-        assert(ndatalen == -1);
-        nghttp3_conn_block_stream(httpconn_, stream_id);
-        continue;
-      case NGTCP2_ERR_STREAM_SHUT_WR:
         assert(ndatalen == -1);
-        nghttp3_conn_shutdown_stream_write(httpconn_, stream_id);
-        continue;
-      case NGTCP2_ERR_WRITE_MORE:
-        assert(ndatalen >= 0);
+
+        std::cerr << "ngtcp2_conn_writev_stream: " << ngtcp2_strerror(nwrite)
+                  << std::endl;
+        ngtcp2_connection_close_error_set_transport_error_liberr(
+            &last_error_, nwrite, nullptr, 0);
+        return handle_error();
+      } else if (ndatalen >= 0) {
         if (auto rv =
                 nghttp3_conn_add_write_offset(httpconn_, stream_id, ndatalen);
             rv != 0) {
@@ -1705,43 +2578,27 @@ int Handler::write_streams() {
               0);
           return handle_error();
         }
-        continue;
-      }
-
-      assert(ndatalen == -1);
-
-      std::cerr << "ngtcp2_conn_writev_stream: " << ngtcp2_strerror(nwrite)
-                << std::endl;
-      ngtcp2_connection_close_error_set_transport_error_liberr(
-          &last_error_, nwrite, nullptr, 0);
-      return handle_error();
-    } else if (ndatalen >= 0) {
-      if (auto rv =
-              nghttp3_conn_add_write_offset(httpconn_, stream_id, ndatalen);
-          rv != 0) {
-        std::cerr << "nghttp3_conn_add_write_offset: " << nghttp3_strerror(rv)
-                  << std::endl;
-        ngtcp2_connection_close_error_set_application_error(
-            &last_error_, nghttp3_err_infer_quic_app_error_code(rv), nullptr,
-            0);
-        return handle_error();
       }
     }
 
     if (nwrite == 0) {
       if (bufpos - tx_.data.get()) {
+        if (protect_pkts() != 0) {
+          return handle_error();
+        }
+
         auto &ep = *static_cast<Endpoint *>(prev_ps.path.user_data);
         auto data = tx_.data.get();
         auto datalen = bufpos - data;
 
-        if (auto [nsent, rv] = server_->send_packet(
-                ep, no_gso_, prev_ps.path.local, prev_ps.path.remote, prev_ecn,
-                data, datalen, gso_size);
+        if (auto [nsent, rv] =
+                send_packet(ep, prev_ps.path.local, prev_ps.path.remote,
+                            prev_ecn, data, datalen, gso_size, txtime);
             rv != NETWORK_ERR_OK) {
           assert(NETWORK_ERR_SEND_BLOCKED == rv);
 
           on_send_blocked(ep, prev_ps.path.local, prev_ps.path.remote, prev_ecn,
-                          data + nsent, datalen - nsent, gso_size);
+                          data + nsent, datalen - nsent, gso_size, txtime);
 
           start_wev_endpoint(ep);
           ngtcp2_conn_update_pkt_tx_time(conn_, ts);
@@ -1758,30 +2615,44 @@ int Handler::write_streams() {
 
     bufpos += nwrite;
 
+    if (trace_ && trace_->started()) {
+      trace_->write_send(static_cast<size_t>(nwrite), ts);
+    }
+
     if (pktcnt == 0) {
       ngtcp2_path_copy(&prev_ps.path, &ps.path);
       prev_ecn = pi.ecn;
       gso_size = nwrite;
+      if (config.txtime) {
+        txtime = pi.tx_ts;
+      }
     } else if (!ngtcp2_path_eq(&prev_ps.path, &ps.path) || prev_ecn != pi.ecn ||
                static_cast<size_t>(nwrite) > gso_size ||
                (gso_size > path_max_udp_payload_size &&
                 static_cast<size_t>(nwrite) != gso_size)) {
+      if (protect_pkts() != 0) {
+        return handle_error();
+      }
+
       auto &ep = *static_cast<Endpoint *>(prev_ps.path.user_data);
       auto data = tx_.data.get();
       auto datalen = bufpos - data - nwrite;
+      // pi_txtime is the departure time of the last packet which
+      // does not belong to this batch.
+      uint64_t pi_txtime = config.txtime ? pi.tx_ts : 0;
 
-      if (auto [nsent, rv] = server_->send_packet(
-              ep, no_gso_, prev_ps.path.local, prev_ps.path.remote, prev_ecn,
-              data, datalen, gso_size);
+      if (auto [nsent, rv] =
+              send_packet(ep, prev_ps.path.local, prev_ps.path.remote,
+                          prev_ecn, data, datalen, gso_size, txtime);
           rv != 0) {
         assert(NETWORK_ERR_SEND_BLOCKED == rv);
 
         on_send_blocked(ep, prev_ps.path.local, prev_ps.path.remote, prev_ecn,
-                        data + nsent, datalen - nsent, gso_size);
+                        data + nsent, datalen - nsent, gso_size, txtime);
 
         on_send_blocked(*static_cast<Endpoint *>(ps.path.user_data),
                         ps.path.local, ps.path.remote, pi.ecn, bufpos - nwrite,
-                        nwrite, 0);
+                        nwrite, 0, pi_txtime);
 
         start_wev_endpoint(ep);
       } else {
@@ -1789,14 +2660,14 @@ int Handler::write_streams() {
         auto data = bufpos - nwrite;
 
         if (auto [nsent, rv] =
-                server_->send_packet(ep, no_gso_, ps.path.local, ps.path.remote,
-                                     pi.ecn, data, nwrite, nwrite);
+                send_packet(ep, ps.path.local, ps.path.remote, pi.ecn, data,
+                            nwrite, nwrite, pi_txtime);
             rv != 0) {
           assert(nsent == 0);
           assert(NETWORK_ERR_SEND_BLOCKED == rv);
 
           on_send_blocked(ep, ps.path.local, ps.path.remote, pi.ecn, data,
-                          nwrite, 0);
+                          nwrite, 0, pi_txtime);
         }
 
         start_wev_endpoint(ep);
@@ -1807,18 +2678,22 @@ int Handler::write_streams() {
     }
 
     if (++pktcnt == max_pktcnt || static_cast<size_t>(nwrite) < gso_size) {
+      if (protect_pkts() != 0) {
+        return handle_error();
+      }
+
       auto &ep = *static_cast<Endpoint *>(ps.path.user_data);
       auto data = tx_.data.get();
       auto datalen = bufpos - data;
 
       if (auto [nsent, rv] =
-              server_->send_packet(ep, no_gso_, ps.path.local, ps.path.remote,
-                                   pi.ecn, data, datalen, gso_size);
+              send_packet(ep, ps.path.local, ps.path.remote, pi.ecn, data,
+                          datalen, gso_size, txtime);
           rv != 0) {
         assert(NETWORK_ERR_SEND_BLOCKED == rv);
 
         on_send_blocked(ep, ps.path.local, ps.path.remote, pi.ecn, data + nsent,
-                        datalen - nsent, gso_size);
+                        datalen - nsent, gso_size, txtime);
       }
 
       start_wev_endpoint(ep);
@@ -1831,7 +2706,7 @@ int Handler::write_streams() {
 void Handler::on_send_blocked(Endpoint &ep, const ngtcp2_addr &local_addr,
                               const ngtcp2_addr &remote_addr, unsigned int ecn,
                               const uint8_t *data, size_t datalen,
-                              size_t gso_size) {
+                              size_t gso_size, uint64_t txtime) {
   assert(tx_.num_blocked || !tx_.send_blocked);
   assert(tx_.num_blocked < 2);
 
@@ -1849,6 +2724,7 @@ void Handler::on_send_blocked(Endpoint &ep, const ngtcp2_addr &local_addr,
   p.data = data;
   p.datalen = datalen;
   p.gso_size = gso_size;
+  p.txtime = txtime;
 }
 
 void Handler::start_wev_endpoint(const Endpoint &ep) {
@@ -1882,7 +2758,7 @@ int Handler::send_blocked_packet() {
 
     auto [nsent, rv] =
         server_->send_packet(*p.endpoint, no_gso_, local_addr, remote_addr,
-                             p.ecn, p.data, p.datalen, p.gso_size);
+                             p.ecn, p.data, p.datalen, p.gso_size, p.txtime);
     if (rv != 0) {
       assert(NETWORK_ERR_SEND_BLOCKED == rv);
 
@@ -1899,44 +2775,107 @@ int Handler::send_blocked_packet() {
   tx_.num_blocked = 0;
   tx_.num_blocked_sent = 0;
 
+  release_txbuf();
+
   return 0;
 }
 
-void Handler::signal_write() { ev_io_start(loop_, &wev_); }
+std::pair<size_t, int>
+Handler::send_packet(Endpoint &ep, const ngtcp2_addr &local_addr,
+                     const ngtcp2_addr &remote_addr, unsigned int ecn,
+                     const uint8_t *data, size_t datalen, size_t gso_size,
+                     uint64_t txtime) {
+  server_->metrics().on_tx(datalen, gso_size);
 
-void Handler::start_draining_period() {
-  ev_io_stop(loop_, &wev_);
+  if (config.send_batch > 1) {
+    server_->queue_packet(this, no_gso_, ep, local_addr, remote_addr, ecn,
+                          data, datalen, gso_size, txtime);
+    return {datalen, NETWORK_ERR_OK};
+  }
 
-  ev_set_cb(&timer_, close_waitcb);
-  timer_.repeat =
-      static_cast<ev_tstamp>(ngtcp2_conn_get_pto(conn_)) / NGTCP2_SECONDS * 3;
-  ev_timer_again(loop_, &timer_);
+  return server_->send_packet(ep, no_gso_, local_addr, remote_addr, ecn, data,
+                              datalen, gso_size, txtime);
+}
 
-  if (!config.quiet) {
-    std::cerr << "Draining period has started (" << timer_.repeat << " seconds)"
+void Handler::prepare_rx_hp_masks(const ngtcp2_vec *pktv, size_t pktvcnt) {
+  if (auto rv = ngtcp2_conn_prepare_rx_hp_masks(conn_, pktv, pktvcnt);
+      rv != 0) {
+    std::cerr << "ngtcp2_conn_prepare_rx_hp_masks: " << ngtcp2_strerror(rv)
               << std::endl;
   }
 }
 
-int Handler::start_closing_period() {
-  if (!conn_ || ngtcp2_conn_is_in_closing_period(conn_) ||
-      ngtcp2_conn_is_in_draining_period(conn_)) {
-    return 0;
+int Handler::protect_pkts() {
+  if (auto rv = ngtcp2_conn_protect_pkts(conn_); rv != 0) {
+    std::cerr << "ngtcp2_conn_protect_pkts: " << ngtcp2_strerror(rv)
+              << std::endl;
+    ngtcp2_connection_close_error_set_transport_error_liberr(&last_error_, rv,
+                                                             nullptr, 0);
+    return -1;
   }
 
-  ev_io_stop(loop_, &wev_);
+  return 0;
+}
 
-  ev_set_cb(&timer_, close_waitcb);
-  timer_.repeat =
-      static_cast<ev_tstamp>(ngtcp2_conn_get_pto(conn_)) / NGTCP2_SECONDS * 3;
-  ev_timer_again(loop_, &timer_);
+bool Handler::send_blocked() const { return tx_.send_blocked; }
 
-  if (!config.quiet) {
-    std::cerr << "Closing period has started (" << timer_.repeat << " seconds)"
-              << std::endl;
-  }
+void Handler::set_tx_queued(bool queued) {
+  tx_.queued = queued;
 
-  conn_closebuf_ = std::make_unique<Buffer>(NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+  if (!queued) {
+    release_txbuf();
+  }
+}
+
+void Handler::release_txbuf() {
+  // The transmit queue may be flushed while write_streams is writing
+  // the next batch to tx_.data.
+  if (!tx_.data || tx_.writing || tx_.queued || tx_.send_blocked) {
+    return;
+  }
+
+  server_->release_txbuf(std::move(tx_.data));
+}
+
+void Handler::signal_write() { ev_io_start(loop_, &wev_); }
+
+void Handler::start_draining_period() {
+  ev_timer_stop(loop_, &timer_);
+  ev_io_stop(loop_, &wev_);
+
+  if (config.timer_wheel) {
+    server_->cancel_timer(&wheel_entry_);
+  }
+
+  if (!config.quiet) {
+    std::cerr << "Draining period has started ("
+              << static_cast<ev_tstamp>(ngtcp2_conn_get_pto(conn_)) /
+                     NGTCP2_SECONDS * 3
+              << " seconds)" << std::endl;
+  }
+}
+
+int Handler::start_closing_period() {
+  if (!conn_ || ngtcp2_conn_is_in_closing_period(conn_) ||
+      ngtcp2_conn_is_in_draining_period(conn_)) {
+    return 0;
+  }
+
+  ev_timer_stop(loop_, &timer_);
+  ev_io_stop(loop_, &wev_);
+
+  if (config.timer_wheel) {
+    server_->cancel_timer(&wheel_entry_);
+  }
+
+  if (!config.quiet) {
+    std::cerr << "Closing period has started ("
+              << static_cast<ev_tstamp>(ngtcp2_conn_get_pto(conn_)) /
+                     NGTCP2_SECONDS * 3
+              << " seconds)" << std::endl;
+  }
+
+  conn_closebuf_ = std::make_unique<Buffer>(NGTCP2_MAX_UDP_PAYLOAD_SIZE);
 
   ngtcp2_path_storage ps;
 
@@ -1991,6 +2930,10 @@ int Handler::send_conn_close() {
   assert(conn_);
   assert(!ngtcp2_conn_is_in_draining_period(conn_));
 
+  if (tx_.queued) {
+    server_->flush_tx();
+  }
+
   auto path = ngtcp2_conn_get_path(conn_);
 
   return server_->send_packet(
@@ -1998,8 +2941,65 @@ int Handler::send_conn_close() {
       /* ecn = */ 0, conn_closebuf_->rpos(), conn_closebuf_->size());
 }
 
+const Buffer *Handler::conn_closebuf() const { return conn_closebuf_.get(); }
+
+int Handler::send_keep_alive() {
+  std::array<uint8_t, NGTCP2_MAX_UDP_PAYLOAD_SIZE> buf;
+  ngtcp2_path_storage ps;
+  ngtcp2_pkt_info pi;
+
+  ngtcp2_path_storage_zero(&ps);
+
+  auto ts = util::timestamp(loop_);
+  auto nwrite = ngtcp2_conn_write_keep_alive(conn_, &ps.path, &pi, buf.data(),
+                                             buf.size(), ts);
+  if (nwrite < 0) {
+    if (nwrite == NGTCP2_ERR_INVALID_STATE) {
+      // The connection is closing, or a packet is being built.
+      return 0;
+    }
+
+    std::cerr << "ngtcp2_conn_write_keep_alive: " << ngtcp2_strerror(nwrite)
+              << std::endl;
+    ngtcp2_connection_close_error_set_transport_error_liberr(
+        &last_error_, nwrite, nullptr, 0);
+    return handle_error();
+  }
+
+  if (nwrite == 0) {
+    return 0;
+  }
+
+  if (trace_ && trace_->started()) {
+    trace_->write_send(static_cast<size_t>(nwrite), ts);
+  }
+
+  if (tx_.queued) {
+    server_->flush_tx();
+  }
+
+  // A lost PING is not retransmitted, and the next window pings the
+  // connection again.
+  server_->send_packet(*static_cast<Endpoint *>(ps.path.user_data),
+                       ps.path.local, ps.path.remote, pi.ecn, buf.data(),
+                       static_cast<size_t>(nwrite));
+
+  update_timer();
+
+  return 0;
+}
+
+TimerWheelEntry *Handler::keep_alive_entry() { return &keep_alive_entry_; }
+
 void Handler::update_timer() {
   auto expiry = ngtcp2_conn_get_expiry(conn_);
+
+  if (config.timer_wheel) {
+    // The expired timer fires in the next event loop iteration.
+    server_->schedule_timer(&wheel_entry_, expiry);
+    return;
+  }
+
   auto now = util::timestamp(loop_);
 
   if (expiry <= now) {
@@ -2049,6 +3049,69 @@ int Handler::recv_stream_data(uint32_t flags, int64_t stream_id,
   return 0;
 }
 
+void Handler::recv_datagram(const uint8_t *data, size_t datalen) {
+  auto dgram = http::decode_http_datagram(data, datalen);
+  if (!dgram) {
+    return;
+  }
+
+  // Only Context ID 0 which carries UDP payload is defined by RFC
+  // 9298.  The others are dropped.
+  if (dgram->context_id != 0) {
+    return;
+  }
+
+  auto it = streams_.find(dgram->stream_id);
+  if (it == std::end(streams_) || !it->second->udp_proxy) {
+    return;
+  }
+
+  auto proxy = it->second->udp_proxy.get();
+
+  if (dgram->payload < rxbuf_.begin ||
+      dgram->payload + dgram->payloadlen > rxbuf_.end) {
+    // ngtcp2 buffered the packet until its key became available, and
+    // frees it when ngtcp2_conn_read_pkts returns.
+    send(proxy->fd, dgram->payload, dgram->payloadlen, 0);
+    return;
+  }
+
+  // The payload is not copied.  It is decrypted in place in the
+  // receive buffer of Server which flushes it before reusing the
+  // buffer.
+  proxy->queue_tx(dgram->payload, dgram->payloadlen);
+  server_->queue_proxy_tx(proxy);
+}
+
+void Handler::queue_proxy_rx(UDPProxy *proxy) {
+  if (!proxy->rx.queued) {
+    proxy->rx.queued = true;
+    proxy_rxq_.push_back(proxy);
+  }
+
+  signal_write();
+}
+
+void Handler::pop_proxy_rx(UDPProxy *proxy) {
+  assert(proxy_rxq_.front() == proxy);
+
+  proxy->pop_rx();
+  proxy_rxq_.pop_front();
+
+  if (proxy->rx.len) {
+    // The tunnels take turns to send a datagram.
+    proxy_rxq_.push_back(proxy);
+  } else {
+    proxy->rx.queued = false;
+  }
+}
+
+void Handler::remove_proxy_rx(UDPProxy *proxy) {
+  proxy_rxq_.erase(std::find(std::begin(proxy_rxq_), std::end(proxy_rxq_),
+                             proxy));
+  proxy->rx.queued = false;
+}
+
 int Handler::update_key(uint8_t *rx_secret, uint8_t *tx_secret,
                         ngtcp2_crypto_aead_ctx *rx_aead_ctx, uint8_t *rx_iv,
                         ngtcp2_crypto_aead_ctx *tx_aead_ctx, uint8_t *tx_iv,
@@ -2063,10 +3126,10 @@ int Handler::update_key(uint8_t *rx_secret, uint8_t *tx_secret,
 
   std::array<uint8_t, 64> rx_key, tx_key;
 
-  if (ngtcp2_crypto_update_key(conn_, rx_secret, tx_secret, rx_aead_ctx,
-                               rx_key.data(), rx_iv, tx_aead_ctx, tx_key.data(),
-                               tx_iv, current_rx_secret, current_tx_secret,
-                               secretlen) != 0) {
+  if (ngtcp2_crypto_update_key_pooled(
+          conn_, rx_secret, tx_secret, rx_aead_ctx, rx_key.data(), rx_iv,
+          tx_aead_ctx, tx_key.data(), tx_iv, current_rx_secret,
+          current_tx_secret, secretlen, &aead_ctx_pool_) != 0) {
     return -1;
   }
 
@@ -2082,8 +3145,47 @@ int Handler::update_key(uint8_t *rx_secret, uint8_t *tx_secret,
   return 0;
 }
 
+void Handler::release_aead_ctx(ngtcp2_crypto_aead_ctx *aead_ctx) {
+  ngtcp2_crypto_aead_ctx_pool_release(&aead_ctx_pool_, aead_ctx);
+}
+
 Server *Handler::server() const { return server_; }
 
+void Handler::dcid_status(int type, const uint8_t *token) {
+  if (!token) {
+    return;
+  }
+
+  auto it = std::find_if(
+      std::begin(reset_tokens_), std::end(reset_tokens_), [token](auto &t) {
+        return memcmp(t.data(), token, t.size()) == 0;
+      });
+
+  switch (type) {
+  case NGTCP2_CONNECTION_ID_STATUS_TYPE_ACTIVATE:
+    if (it != std::end(reset_tokens_)) {
+      return;
+    }
+
+    std::copy_n(token, NGTCP2_STATELESS_RESET_TOKENLEN,
+                std::begin(reset_tokens_.emplace_back()));
+    server_->associate_reset_token(token, this);
+
+    return;
+  case NGTCP2_CONNECTION_ID_STATUS_TYPE_DEACTIVATE:
+    if (it == std::end(reset_tokens_)) {
+      return;
+    }
+
+    reset_tokens_.erase(it);
+    server_->dissociate_reset_token(token, this);
+
+    return;
+  }
+}
+
+struct ev_loop *Handler::loop() const { return loop_; }
+
 int Handler::on_stream_close(int64_t stream_id, uint64_t app_error_code) {
   if (!config.quiet) {
     std::cerr << "QUIC stream " << stream_id << " closed" << std::endl;
@@ -2110,6 +3212,23 @@ int Handler::on_stream_close(int64_t stream_id, uint64_t app_error_code) {
           &last_error_, nghttp3_err_infer_quic_app_error_code(rv), nullptr, 0);
       return -1;
     }
+
+    // The critical streams of client are never closed while the
+    // connection is alive.  The other unidirectional streams, e.g.,
+    // those of the unknown types which HTTP/3 stack discards, are
+    // replaced as they close.
+    if (!ngtcp2_is_bidi_stream(stream_id) &&
+        !ngtcp2_conn_is_local_stream(conn_, stream_id)) {
+      ngtcp2_conn_extend_max_streams_uni(conn_, 1);
+    }
+  }
+
+  // Refresh the token so that it carries the congestion control state
+  // learned while serving the stream.  The client uses the latest
+  // token when it comes back.
+  if (ngtcp2_conn_get_handshake_completed(conn_) &&
+      util::timestamp(loop_) - last_token_ts_ >= NGTCP2_SECONDS) {
+    return submit_new_token();
   }
 
   return 0;
@@ -2133,24 +3252,213 @@ void siginthandler(struct ev_loop *loop, ev_signal *watcher, int revents) {
 }
 } // namespace
 
-Server::Server(struct ev_loop *loop, TLSServerContext &tls_ctx)
-    : loop_(loop), tls_ctx_(tls_ctx) {
+namespace {
+void txprepcb(struct ev_loop *loop, ev_prepare *w, int revents) {
+  auto s = static_cast<Server *>(w->data);
+
+  s->flush_tx();
+}
+} // namespace
+
+namespace {
+void wheeltimeoutcb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto s = static_cast<Server *>(w->data);
+
+  s->on_timer_wheel();
+}
+} // namespace
+
+namespace {
+void wheelprepcb(struct ev_loop *loop, ev_prepare *w, int revents) {
+  auto s = static_cast<Server *>(w->data);
+
+  s->update_wheel_timer();
+}
+} // namespace
+
+namespace {
+void sockbufcb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto s = static_cast<Server *>(w->data);
+
+  s->update_sock_buf();
+}
+} // namespace
+
+namespace {
+void tombstonecb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto s = static_cast<Server *>(w->data);
+
+  s->expire_tombstones();
+}
+} // namespace
+
+namespace {
+void keepalivecb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto s = static_cast<Server *>(w->data);
+
+  s->on_keep_alive();
+}
+} // namespace
+
+namespace {
+void netemcb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto s = static_cast<Server *>(w->data);
+
+  s->on_netem();
+}
+} // namespace
+
+namespace {
+// keep_alive_window returns the batch window of keep-alive for
+// |timeout|.  It is the coarsest granularity of the levels of
+// TimerWheel which does not exceed 1/8 of |timeout|.
+ngtcp2_duration keep_alive_window(ngtcp2_duration timeout) {
+  ngtcp2_duration window = 1ull << TimerWheel::TICK_SHIFT;
+
+  for (size_t i = 1; i < TimerWheel::NLEVEL; ++i) {
+    auto w = window << TimerWheel::LEVEL_SHIFT;
+    if (w > timeout / 8) {
+      break;
+    }
+
+    window = w;
+  }
+
+  return window;
+}
+} // namespace
+
+#ifdef HAVE_LIBURING
+namespace {
+void uringreadcb(struct ev_loop *loop, ev_io *w, int revents) {
+  auto s = static_cast<Server *>(w->data);
+
+  s->on_uring_read();
+}
+} // namespace
+#endif // HAVE_LIBURING
+
+#ifdef HAVE_LIBBPF
+namespace {
+void xdpreadcb(struct ev_loop *loop, ev_io *w, int revents) {
+  auto s = static_cast<Server *>(w->data);
+
+  s->on_xdp_read();
+}
+} // namespace
+#endif // HAVE_LIBBPF
+
+#ifdef HAVE_LIBDPDK
+namespace {
+void dpdkpollcb(struct ev_loop *loop, ev_idle *w, int revents) {
+  auto s = static_cast<Server *>(w->data);
+
+  s->on_dpdk_poll();
+}
+} // namespace
+#endif // HAVE_LIBDPDK
+
+Server::Server(struct ev_loop *loop, TLSServerContext &tls_ctx,
+               uint8_t worker_id)
+    : loop_(loop),
+      tls_ctx_(tls_ctx),
+      rx_stats_{},
+      tx_stats_{},
+      file_stats_{},
+      early_data_stats_{},
+      metrics_(&get_metrics_registry().add_worker(worker_id)),
+      tp_template_{},
+      worker_id_(worker_id),
+      preferred_ipv4_addr_{},
+      preferred_ipv6_addr_{},
+      token_ctx_{},
+      retry_ctx_{},
+      vn_sv_{},
+      vn_svlen_{},
+      lb_cid_ctx_{},
+      lb_config_{},
+      stateless_reset_{
+          .budget = stateless_reset_burst,
+          .last_ts = 0,
+      },
+      admission_{},
+      timers_{
+          .wheel = TimerWheel(util::timestamp(loop)),
+          .armed = UINT64_MAX,
+      },
+      sock_buf_{},
+      tombstones_{},
+      keep_alive_{
+          .wheel = TimerWheel(util::timestamp(loop)),
+          .window = keep_alive_window(config.keep_alive_timeout),
+          .armed = UINT64_MAX,
+      },
+      netem_{} {
+  ngtcp2_crypto_initial_key_cache_init(&initial_key_cache_);
   ev_signal_init(&sigintev_, siginthandler, SIGINT);
+  ev_prepare_init(&tx_.prep, txprepcb);
+  tx_.prep.data = this;
+  ev_timer_init(&timers_.timer, wheeltimeoutcb, 0., 0.);
+  timers_.timer.data = this;
+  ev_prepare_init(&timers_.prep, wheelprepcb);
+  timers_.prep.data = this;
+  ev_timer_init(&sock_buf_.timer, sockbufcb, 0., 1.);
+  sock_buf_.timer.data = this;
+  ev_timer_init(&tombstones_.timer, tombstonecb, 0., 0.);
+  tombstones_.timer.data = this;
+  ev_timer_init(&keep_alive_.timer, keepalivecb, 0., 0.);
+  keep_alive_.timer.data = this;
+  if (config.netem) {
+    netem_.link = std::make_unique<NetEm>(*config.netem);
+  }
+  ev_timer_init(&netem_.timer, netemcb, 0., 0.);
+  netem_.timer.data = this;
+#ifdef HAVE_LIBURING
+  uring_.initialized = false;
+  uring_.br = nullptr;
+  uring_.efd = -1;
+  ev_io_init(&uring_.rev, uringreadcb, 0, EV_READ);
+  uring_.rev.data = this;
+#endif // HAVE_LIBURING
+#ifdef HAVE_LIBBPF
+  ev_io_init(&xdp_.rev, xdpreadcb, 0, EV_READ);
+  xdp_.rev.data = this;
+#endif // HAVE_LIBBPF
+#ifdef HAVE_LIBDPDK
+  ev_idle_init(&dpdk_.idle, dpdkpollcb);
+  dpdk_.idle.data = this;
+#endif // HAVE_LIBDPDK
 }
 
 Server::~Server() {
   disconnect();
   close();
+
+  ngtcp2_crypto_token_ctx_free(&token_ctx_);
+  ngtcp2_crypto_retry_ctx_free(&retry_ctx_);
+
+  if (!config.quic_lb_key.empty()) {
+    ngtcp2_crypto_cid_ctx_free(&lb_cid_ctx_);
+  }
 }
 
 void Server::disconnect() {
   config.tx_loss_prob = 0;
+  // CONNECTION_CLOSE bypasses the emulated link.
+  netem_.link.reset();
 
   for (auto &ep : endpoints_) {
     ev_io_stop(loop_, &ep.rev);
   }
 
   ev_signal_stop(loop_, &sigintev_);
+  ev_prepare_stop(loop_, &tx_.prep);
+  ev_prepare_stop(loop_, &timers_.prep);
+  ev_timer_stop(loop_, &timers_.timer);
+  ev_timer_stop(loop_, &sock_buf_.timer);
+  ev_timer_stop(loop_, &tombstones_.timer);
+  ev_timer_stop(loop_, &keep_alive_.timer);
+  ev_timer_stop(loop_, &netem_.timer);
 
   while (!handlers_.empty()) {
     auto it = std::begin(handlers_);
@@ -2160,9 +3468,35 @@ void Server::disconnect() {
 
     remove(h);
   }
+
+  for (auto &t : tombstones_.entries) {
+    for (auto &cid : t.cids) {
+      tombstones_.cids.erase(&cid);
+    }
+  }
+
+  tombstones_.entries.clear();
 }
 
 void Server::close() {
+#ifdef HAVE_LIBURING
+  uring_free();
+#endif // HAVE_LIBURING
+
+#ifdef HAVE_LIBBPF
+  if (xdp_.sock) {
+    ev_io_stop(loop_, &xdp_.rev);
+    xdp_.sock.reset();
+  }
+#endif // HAVE_LIBBPF
+
+#ifdef HAVE_LIBDPDK
+  if (dpdk_.queue) {
+    ev_idle_stop(loop_, &dpdk_.idle);
+    dpdk_.queue.reset();
+  }
+#endif // HAVE_LIBDPDK
+
   for (auto &ep : endpoints_) {
     ::close(ep.fd);
   }
@@ -2225,9 +3559,27 @@ int create_sock(Address &local_addr, const char *addr, const char *port,
       continue;
     }
 
+    if (config.workers > 1 &&
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &val,
+                   static_cast<socklen_t>(sizeof(val))) == -1) {
+      close(fd);
+      continue;
+    }
+
     fd_set_recv_ecn(fd, rp->ai_family);
     fd_set_ip_mtu_discover(fd, rp->ai_family);
     fd_set_ip_dontfrag(fd, family);
+    fd_set_rxq_ovfl(fd);
+
+    if (config.gro && fd_set_udp_gro(fd) != 0) {
+      close(fd);
+      continue;
+    }
+
+    if (config.txtime && fd_set_txtime(fd) != 0) {
+      close(fd);
+      continue;
+    }
 
     if (bind(fd, rp->ai_addr, rp->ai_addrlen) != -1) {
       break;
@@ -2275,7 +3627,8 @@ int add_endpoint(std::vector<Endpoint> &endpoints, const char *addr,
 } // namespace
 
 namespace {
-int add_endpoint(std::vector<Endpoint> &endpoints, const Address &addr) {
+int add_endpoint(std::vector<Endpoint> &endpoints, const Address &addr,
+                 bool worker_only) {
   auto fd = util::create_nonblock_socket(addr.su.sa.sa_family, SOCK_DGRAM, 0);
   if (fd == -1) {
     std::cerr << "socket: " << strerror(errno) << std::endl;
@@ -2310,9 +3663,28 @@ int add_endpoint(std::vector<Endpoint> &endpoints, const Address &addr) {
     return -1;
   }
 
+  if (!worker_only && config.workers > 1 &&
+      setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &val,
+                 static_cast<socklen_t>(sizeof(val))) == -1) {
+    std::cerr << "setsockopt: " << strerror(errno) << std::endl;
+    close(fd);
+    return -1;
+  }
+
   fd_set_recv_ecn(fd, addr.su.sa.sa_family);
   fd_set_ip_mtu_discover(fd, addr.su.sa.sa_family);
   fd_set_ip_dontfrag(fd, addr.su.sa.sa_family);
+  fd_set_rxq_ovfl(fd);
+
+  if (config.gro && fd_set_udp_gro(fd) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  if (config.txtime && fd_set_txtime(fd) != 0) {
+    close(fd);
+    return -1;
+  }
 
   if (bind(fd, &addr.su.sa, addr.len) == -1) {
     std::cerr << "bind: " << strerror(errno) << std::endl;
@@ -2324,6 +3696,7 @@ int add_endpoint(std::vector<Endpoint> &endpoints, const Address &addr) {
   auto &ep = endpoints.back();
   ep.addr = addr;
   ep.fd = fd;
+  ep.worker_only = worker_only;
   ev_io_init(&ep.rev, sreadcb, 0, EV_READ);
 
   return 0;
@@ -2331,6 +3704,54 @@ int add_endpoint(std::vector<Endpoint> &endpoints, const Address &addr) {
 } // namespace
 
 int Server::init(const char *addr, const char *port) {
+  if (ngtcp2_crypto_token_ctx_init(&token_ctx_, config.static_secret.data(),
+                                   config.static_secret.size()) != 0) {
+    std::cerr << "ngtcp2_crypto_token_ctx_init failed" << std::endl;
+    return -1;
+  }
+
+  if (ngtcp2_crypto_retry_ctx_init(&retry_ctx_) != 0) {
+    std::cerr << "ngtcp2_crypto_retry_ctx_init failed" << std::endl;
+    return -1;
+  }
+
+  vn_svlen_ = 1;
+
+  if (config.preferred_versions.empty()) {
+    vn_sv_[vn_svlen_++] = NGTCP2_PROTO_VER_V1;
+  } else {
+    for (auto v : config.preferred_versions) {
+      vn_sv_[vn_svlen_++] = v;
+    }
+  }
+
+  if (util::generate_secure_random(
+          reinterpret_cast<uint8_t *>(&admission_.seed),
+          sizeof(admission_.seed)) != 0) {
+    std::cerr << "Could not generate admission seed" << std::endl;
+    return -1;
+  }
+
+  if (!config.quic_lb_server_id.empty()) {
+    lb_config_.config_id = config.quic_lb_config_id;
+    lb_config_.server_idlen = config.quic_lb_server_id.size();
+    std::copy(std::begin(config.quic_lb_server_id),
+              std::end(config.quic_lb_server_id), lb_config_.server_id);
+    lb_config_.noncelen = NGTCP2_SV_SCIDLEN - 1 - lb_config_.server_idlen;
+
+    if (!config.quic_lb_key.empty()) {
+      if (ngtcp2_crypto_cid_ctx_init(
+              &lb_cid_ctx_,
+              reinterpret_cast<const uint8_t *>(config.quic_lb_key.data()),
+              config.quic_lb_key.size()) != 0) {
+        std::cerr << "ngtcp2_crypto_cid_ctx_init failed" << std::endl;
+        return -1;
+      }
+
+      lb_config_.cid_ctx = &lb_cid_ctx_;
+    }
+  }
+
   endpoints_.reserve(4);
 
   auto ready = false;
@@ -2346,35 +3767,158 @@ int Server::init(const char *addr, const char *port) {
     return -1;
   }
 
-  if (config.preferred_ipv4_addr.len &&
-      add_endpoint(endpoints_, config.preferred_ipv4_addr) != 0) {
+  preferred_ipv4_addr_ = config.preferred_ipv4_addr;
+  preferred_ipv6_addr_ = config.preferred_ipv6_addr;
+
+  if (config.preferred_addr_per_worker) {
+    // Each worker listens on its own port so that a connection which
+    // migrates to the preferred address reaches this worker
+    // directly.
+    for (auto addr : {&preferred_ipv4_addr_, &preferred_ipv6_addr_}) {
+      if (!addr->len) {
+        continue;
+      }
+
+      auto &port = addr->su.sa.sa_family == AF_INET ? addr->su.in.sin_port
+                                                    : addr->su.in6.sin6_port;
+      auto n = static_cast<uint32_t>(ntohs(port)) + worker_id_;
+      if (n > 65535) {
+        std::cerr << "preferred-addr-per-worker: port number exceeds 65535"
+                  << std::endl;
+        return -1;
+      }
+
+      port = htons(static_cast<uint16_t>(n));
+    }
+  }
+
+  if (preferred_ipv4_addr_.len &&
+      add_endpoint(endpoints_, preferred_ipv4_addr_,
+                   config.preferred_addr_per_worker) != 0) {
     return -1;
   }
-  if (config.preferred_ipv6_addr.len &&
-      add_endpoint(endpoints_, config.preferred_ipv6_addr) != 0) {
+  if (preferred_ipv6_addr_.len &&
+      add_endpoint(endpoints_, preferred_ipv6_addr_,
+                   config.preferred_addr_per_worker) != 0) {
     return -1;
   }
 
-  for (auto &ep : endpoints_) {
-    ep.server = this;
-    ep.rev.data = &ep;
+#ifdef HAVE_RECVMMSG
+  if (config.recv_batch > 1) {
+    auto batch = config.recv_batch;
+
+    rx_.data = std::make_unique<uint8_t[]>(batch * rx_bufsize);
+    rx_.msgs.resize(batch);
+    rx_.iovs.resize(batch);
+    rx_.addrs.resize(batch);
+    rx_.ctrl.resize(batch * rx_msg_ctrllen);
+    rx_.info.resize(batch);
+    rx_.dgrams.resize(batch);
+    rx_.ents.resize(batch);
+
+    for (size_t i = 0; i < batch; ++i) {
+      auto &iov = rx_.iovs[i];
+      iov.iov_base = rx_.data.get() + i * rx_bufsize;
+      iov.iov_len = rx_bufsize;
+
+      auto &msg = rx_.msgs[i].msg_hdr;
+      msg = msghdr{};
+      msg.msg_name = &rx_.addrs[i];
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = rx_.ctrl.data() + i * rx_msg_ctrllen;
+    }
+  }
+#endif // HAVE_RECVMMSG
 
-    ev_io_set(&ep.rev, ep.fd, EV_READ);
+  if (config.send_batch > 1) {
+    tx_.entries.reserve(config.send_batch);
+
+    // Flush the entries queued during an event loop iteration before
+    // the loop blocks.
+    ev_prepare_start(loop_, &tx_.prep);
+  }
+
+  if (config.timer_wheel) {
+    // Arm the single ev_timer to the earliest entry of the wheel
+    // before the loop blocks.
+    ev_prepare_start(loop_, &timers_.prep);
+  }
+
+  for (auto &ep : endpoints_) {
+    ep.server = this;
+    ep.rev.data = &ep;
+
+    if (!config.worker_cpus.empty() &&
+        fd_set_incoming_cpu(
+            ep.fd, static_cast<int>(config.worker_cpus[worker_id_])) != 0) {
+      return -1;
+    }
+
+    if (config.busy_poll &&
+        fd_set_busy_poll(ep.fd, static_cast<int>(config.busy_poll)) != 0) {
+      return -1;
+    }
+
+    ev_io_set(&ep.rev, ep.fd, EV_READ);
+
+#ifdef HAVE_LIBURING
+    if (config.io_uring) {
+      continue;
+    }
+#endif // HAVE_LIBURING
 
     ev_io_start(loop_, &ep.rev);
   }
 
-  ev_signal_start(loop_, &sigintev_);
+  if (!endpoints_.empty()) {
+    if (auto n = fd_get_rcvbuf(endpoints_[0].fd); n > 0) {
+      sock_buf_.size = static_cast<uint64_t>(n);
+      metrics_->sock_buf_bytes.add(n);
+    }
+
+    if (config.sock_buf_max) {
+      sock_buf_.min = std::min(sock_buf_.size, config.sock_buf_max);
+
+      ev_timer_again(loop_, &sock_buf_.timer);
+    }
+  }
+
+#ifdef HAVE_LIBURING
+  if (config.io_uring && uring_init() != 0) {
+    return -1;
+  }
+#endif // HAVE_LIBURING
+
+#ifdef HAVE_LIBBPF
+  if (xdp_program && xdp_init(*xdp_program) != 0) {
+    return -1;
+  }
+#endif // HAVE_LIBBPF
+
+#ifdef HAVE_LIBDPDK
+  if (dpdk_port && dpdk_init(*dpdk_port) != 0) {
+    return -1;
+  }
+#endif // HAVE_LIBDPDK
+
+  if (config.workers == 1) {
+    ev_signal_start(loop_, &sigintev_);
+  }
 
   return 0;
 }
 
 int Server::on_read(Endpoint &ep) {
+#ifdef HAVE_RECVMMSG
+  if (config.recv_batch > 1) {
+    return on_read_batch(ep);
+  }
+#endif // HAVE_RECVMMSG
+
   sockaddr_union su;
-  std::array<uint8_t, 64_k> buf;
-  ngtcp2_pkt_hd hd;
+  std::array<uint8_t, rx_bufsize> buf;
   size_t pktcnt = 0;
-  ngtcp2_pkt_info pi;
 
   iovec msg_iov;
   msg_iov.iov_base = buf.data();
@@ -2385,8 +3929,7 @@ int Server::on_read(Endpoint &ep) {
   msg.msg_iov = &msg_iov;
   msg.msg_iovlen = 1;
 
-  uint8_t
-      msg_ctrl[CMSG_SPACE(sizeof(uint8_t)) + CMSG_SPACE(sizeof(in6_pktinfo))];
+  uint8_t msg_ctrl[rx_msg_ctrllen];
   msg.msg_control = msg_ctrl;
 
   for (; pktcnt < 10;) {
@@ -2403,640 +3946,2240 @@ int Server::on_read(Endpoint &ep) {
 
     ++pktcnt;
 
-    pi.ecn = msghdr_get_ecn(&msg, su.storage.ss_family);
-    auto local_addr = msghdr_get_local_addr(&msg, su.storage.ss_family);
-    if (!local_addr) {
-      std::cerr << "Unable to obtain local address" << std::endl;
-      continue;
-    }
-
-    set_port(*local_addr, ep.addr);
-
-    if (!config.quiet) {
-      std::array<char, IF_NAMESIZE> ifname;
-      std::cerr << "Received packet: local="
-                << util::straddr(&local_addr->su.sa, local_addr->len)
-                << " remote=" << util::straddr(&su.sa, msg.msg_namelen)
-                << " if=" << if_indextoname(local_addr->ifindex, ifname.data())
-                << " ecn=0x" << std::hex << pi.ecn << std::dec << " " << nread
-                << " bytes" << std::endl;
-    }
-
-    if (debug::packet_lost(config.rx_loss_prob)) {
-      if (!config.quiet) {
-        std::cerr << "** Simulated incoming packet loss **" << std::endl;
-      }
-      continue;
-    }
-
-    if (nread == 0) {
-      continue;
-    }
+    ++rx_stats_.ncall;
+    ++rx_stats_.ndgram;
 
-    ngtcp2_version_cid vc;
+    on_read_msg(ep, &msg, buf.data(), nread);
 
-    switch (auto rv = ngtcp2_pkt_decode_version_cid(&vc, buf.data(), nread,
-                                                    NGTCP2_SV_SCIDLEN);
-            rv) {
-    case 0:
-      break;
-    case NGTCP2_ERR_VERSION_NEGOTIATION:
-      send_version_negotiation(vc.version, vc.scid, vc.scidlen, vc.dcid,
-                               vc.dcidlen, ep, *local_addr, &su.sa,
-                               msg.msg_namelen);
-      continue;
-    default:
-      std::cerr << "Could not decode version and CID from QUIC packet header: "
-                << ngtcp2_strerror(rv) << std::endl;
-      continue;
-    }
+    // The next recvmsg overwrites buf.
+    flush_proxy_tx();
+  }
 
-    auto dcid_key = util::make_cid_key(vc.dcid, vc.dcidlen);
+  return 0;
+}
 
-    auto handler_it = handlers_.find(dcid_key);
-    if (handler_it == std::end(handlers_)) {
-      switch (auto rv = ngtcp2_accept(&hd, buf.data(), nread); rv) {
-      case 0:
-        break;
-      case NGTCP2_ERR_RETRY:
-        send_retry(&hd, ep, *local_addr, &su.sa, msg.msg_namelen, nread * 3);
-        continue;
-      default:
-        if (!config.quiet) {
-          std::cerr << "Unexpected packet received: length=" << nread
-                    << std::endl;
-        }
-        continue;
-      }
+#ifdef HAVE_RECVMMSG
+namespace {
+// same_dcid returns true if the datagrams |a| and |b| were decoded,
+// and have the same Destination Connection ID.
+bool same_dcid(const ngtcp2_pkt_batch_entry &a,
+               const ngtcp2_pkt_batch_entry &b) {
+  return a.rv == 0 && b.rv == 0 && a.vc.dcidlen == b.vc.dcidlen &&
+         memcmp(a.vc.dcid, b.vc.dcid, a.vc.dcidlen) == 0;
+}
+} // namespace
 
-      ngtcp2_cid ocid;
-      ngtcp2_cid *pocid = nullptr;
+void Server::prefetch_conn(const ngtcp2_pkt_batch_entry &ent) {
+  if (ent.rv != 0) {
+    return;
+  }
 
-      assert(hd.type == NGTCP2_PKT_INITIAL);
+  auto ph = handlers_.find(ent.vc.dcid, ent.vc.dcidlen);
+  if (!ph) {
+    return;
+  }
 
-      if (config.validate_addr || hd.token.len) {
-        std::cerr << "Perform stateless address validation" << std::endl;
-        if (hd.token.len == 0) {
-          send_retry(&hd, ep, *local_addr, &su.sa, msg.msg_namelen, nread * 3);
-          continue;
-        }
+  ngtcp2_conn_prefetch((*ph)->conn());
+}
 
-        if (hd.token.base[0] != NGTCP2_CRYPTO_TOKEN_MAGIC_RETRY &&
-            hd.dcid.datalen < NGTCP2_MIN_INITIAL_DCIDLEN) {
-          send_stateless_connection_close(&hd, ep, *local_addr, &su.sa,
-                                          msg.msg_namelen);
-          continue;
-        }
+int Server::on_read_batch(Endpoint &ep) {
+  auto batch = config.recv_batch;
 
-        switch (hd.token.base[0]) {
-        case NGTCP2_CRYPTO_TOKEN_MAGIC_RETRY:
-          if (verify_retry_token(&ocid, &hd, &su.sa, msg.msg_namelen) != 0) {
-            send_stateless_connection_close(&hd, ep, *local_addr, &su.sa,
-                                            msg.msg_namelen);
-            continue;
-          }
-          pocid = &ocid;
-          break;
-        case NGTCP2_CRYPTO_TOKEN_MAGIC_REGULAR:
-          if (verify_token(&hd, &su.sa, msg.msg_namelen) != 0) {
-            if (config.validate_addr) {
-              send_retry(&hd, ep, *local_addr, &su.sa, msg.msg_namelen,
-                         nread * 3);
-              continue;
-            }
-
-            hd.token.base = nullptr;
-            hd.token.len = 0;
-          }
-          break;
-        default:
-          if (!config.quiet) {
-            std::cerr << "Ignore unrecognized token" << std::endl;
-          }
-          if (config.validate_addr) {
-            send_retry(&hd, ep, *local_addr, &su.sa, msg.msg_namelen,
-                       nread * 3);
-            continue;
-          }
+  for (size_t ncall = 0; ncall < 10; ++ncall) {
+    for (size_t i = 0; i < batch; ++i) {
+      auto &msg = rx_.msgs[i].msg_hdr;
+      msg.msg_namelen = sizeof(rx_.addrs[i]);
+      msg.msg_controllen = rx_msg_ctrllen;
+      rx_.msgs[i].msg_len = 0;
+    }
 
-          hd.token.base = nullptr;
-          hd.token.len = 0;
-          break;
-        }
-      }
+    int nmsg;
 
-      auto h = std::make_unique<Handler>(loop_, this);
-      if (h->init(ep, *local_addr, &su.sa, msg.msg_namelen, &hd.scid, &hd.dcid,
-                  pocid, hd.token.base, hd.token.len, hd.version,
-                  tls_ctx_) != 0) {
-        continue;
-      }
+    do {
+      nmsg = recvmmsg(ep.fd, rx_.msgs.data(), batch, 0, nullptr);
+    } while (nmsg == -1 && errno == EINTR);
 
-      switch (h->on_read(ep, *local_addr, &su.sa, msg.msg_namelen, &pi,
-                         buf.data(), nread)) {
-      case 0:
-        break;
-      case NETWORK_ERR_RETRY:
-        send_retry(&hd, ep, *local_addr, &su.sa, msg.msg_namelen, nread * 3);
-        continue;
-      default:
-        continue;
+    if (nmsg == -1) {
+      if (!(errno == EAGAIN || errno == ENOTCONN)) {
+        std::cerr << "recvmmsg: " << strerror(errno) << std::endl;
       }
+      return 0;
+    }
 
-      switch (h->on_write()) {
-      case 0:
-        break;
-      default:
-        continue;
-      }
+    ++rx_stats_.ncall;
+    rx_stats_.ndgram += nmsg;
+    rx_stats_.max_batch =
+        std::max(rx_stats_.max_batch, static_cast<size_t>(nmsg));
 
-      std::array<ngtcp2_cid, 2> scids;
-      auto conn = h->conn();
+    auto n = static_cast<size_t>(nmsg);
 
-      auto num_scid = ngtcp2_conn_get_num_scid(conn);
+    for (size_t i = 0; i < n; ++i) {
+      rx_.dgrams[i].base = static_cast<uint8_t *>(rx_.iovs[i].iov_base);
+      rx_.dgrams[i].len = rx_.msgs[i].msg_len;
+    }
 
-      assert(num_scid <= scids.size());
+    // Process the datagrams of a connection back to back so that its
+    // state stays in cache.  The packets of a connection are not
+    // reordered.
+    ngtcp2_pkt_group_by_dcid(rx_.ents.data(), rx_.dgrams.data(), n,
+                             NGTCP2_SV_SCIDLEN);
 
-      ngtcp2_conn_get_scid(conn, scids.data());
+    // Start loading the CID table slots for the whole batch before
+    // the packets are processed one by one.
+    for (size_t i = 0; i < n; ++i) {
+      auto &ent = rx_.ents[i];
 
-      for (size_t i = 0; i < num_scid; ++i) {
-        handlers_.emplace(util::make_cid_key(&scids[i]), h.get());
+      if (ent.rv == 0) {
+        handlers_.prefetch(ent.vc.dcid, ent.vc.dcidlen);
       }
+    }
 
-      handlers_.emplace(dcid_key, h.get());
+    auto &info = rx_.info;
 
-      h.release();
+    mmsghdr_get_recv_info(info, rx_.msgs.data(), n);
 
-      continue;
+    // The counter is cumulative, and must be seen in the order of
+    // arrival.
+    for (size_t i = 0; i < n; ++i) {
+      on_rxq_drops(ep, info.drops[i]);
     }
 
-    auto h = (*handler_it).second;
-    auto conn = h->conn();
-    if (ngtcp2_conn_is_in_closing_period(conn)) {
-      // TODO do exponential backoff.
-      switch (h->send_conn_close()) {
-      case 0:
-        break;
-      default:
-        remove(h);
+    prefetch_conn(rx_.ents[0]);
+
+    for (size_t k = 0; k < n; ++k) {
+      auto i = rx_.ents[k].index;
+      auto &mmsg = rx_.msgs[i];
+      auto &msg = mmsg.msg_hdr;
+
+      // Start loading the connection of the next group while this
+      // one is processed.
+      if (k + 1 < n && !same_dcid(rx_.ents[k], rx_.ents[k + 1])) {
+        prefetch_conn(rx_.ents[k + 1]);
       }
-      continue;
-    }
-    if (ngtcp2_conn_is_in_draining_period(conn)) {
-      continue;
+
+      on_read_dgram(ep, static_cast<const sockaddr *>(msg.msg_name),
+                    msg.msg_namelen, info.pi[i], info.local_addr[i],
+                    info.gso_size[i],
+                    static_cast<uint8_t *>(rx_.iovs[i].iov_base), mmsg.msg_len);
     }
 
-    if (auto rv = h->on_read(ep, *local_addr, &su.sa, msg.msg_namelen, &pi,
-                             buf.data(), nread);
-        rv != 0) {
-      if (rv != NETWORK_ERR_CLOSE_WAIT) {
-        remove(h);
-      }
-      continue;
+    // The HTTP Datagrams of the whole batch are forwarded with a
+    // single sendmmsg per tunnel before the next recvmmsg overwrites
+    // them.
+    flush_proxy_tx();
+
+    if (static_cast<size_t>(nmsg) < batch) {
+      return 0;
     }
 
-    h->signal_write();
+    ++rx_stats_.nfull;
   }
 
   return 0;
 }
+#endif // HAVE_RECVMMSG
 
-namespace {
-uint32_t generate_reserved_version(const sockaddr *sa, socklen_t salen,
-                                   uint32_t version) {
-  uint32_t h = 0x811C9DC5u;
-  const uint8_t *p = (const uint8_t *)sa;
-  const uint8_t *ep = p + salen;
-  for (; p != ep; ++p) {
-    h ^= *p;
-    h *= 0x01000193u;
+#ifdef HAVE_LIBURING
+int Server::uring_init() {
+  if (auto rv = io_uring_queue_init(uring_entries, &uring_.ring, 0); rv < 0) {
+    std::cerr << "io_uring_queue_init: " << strerror(-rv) << std::endl;
+    return -1;
   }
-  version = htonl(version);
-  p = (const uint8_t *)&version;
-  ep = p + sizeof(version);
-  for (; p != ep; ++p) {
-    h ^= *p;
-    h *= 0x01000193u;
+
+  uring_.initialized = true;
+
+  int rv;
+
+  uring_.br = io_uring_setup_buf_ring(&uring_.ring, uring_nbuf, uring_bgid, 0,
+                                      &rv);
+  if (!uring_.br) {
+    std::cerr << "io_uring_setup_buf_ring: " << strerror(-rv) << std::endl;
+    return -1;
   }
-  h &= 0xf0f0f0f0u;
-  h |= 0x0a0a0a0au;
-  return h;
-}
-} // namespace
 
-int Server::send_version_negotiation(uint32_t version, const uint8_t *dcid,
-                                     size_t dcidlen, const uint8_t *scid,
-                                     size_t scidlen, Endpoint &ep,
-                                     const Address &local_addr,
-                                     const sockaddr *sa, socklen_t salen) {
-  Buffer buf{NGTCP2_MAX_UDP_PAYLOAD_SIZE};
-  std::array<uint32_t, 1 + max_preferred_versionslen> sv;
+  // Multishot recvmsg uses only msg_namelen and msg_controllen of
+  // this template.  Each buffer receives io_uring_recvmsg_out, the
+  // remote address, ancillary data, and the payload in this order.
+  uring_.msg = msghdr{};
+  uring_.msg.msg_namelen = sizeof(sockaddr_union);
+  uring_.msg.msg_controllen = rx_msg_ctrllen;
 
-  auto p = std::begin(sv);
+  uring_.bufsize = sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_union) +
+                   rx_msg_ctrllen + rx_bufsize;
+  uring_.bufs = std::make_unique<uint8_t[]>(uring_nbuf * uring_.bufsize);
 
-  *p++ = generate_reserved_version(sa, salen, version);
+  auto mask = io_uring_buf_ring_mask(uring_nbuf);
 
-  if (config.preferred_versions.empty()) {
-    *p++ = NGTCP2_PROTO_VER_V1;
-  } else {
-    for (auto v : config.preferred_versions) {
-      *p++ = v;
-    }
+  for (unsigned int i = 0; i < uring_nbuf; ++i) {
+    io_uring_buf_ring_add(uring_.br, uring_.bufs.get() + i * uring_.bufsize,
+                          uring_.bufsize, i, mask, i);
   }
 
-  auto nwrite = ngtcp2_pkt_write_version_negotiation(
-      buf.wpos(), buf.left(),
-      std::uniform_int_distribution<uint8_t>(
-          0, std::numeric_limits<uint8_t>::max())(randgen),
-      dcid, dcidlen, scid, scidlen, sv.data(), p - std::begin(sv));
-  if (nwrite < 0) {
-    std::cerr << "ngtcp2_pkt_write_version_negotiation: "
-              << ngtcp2_strerror(nwrite) << std::endl;
+  io_uring_buf_ring_advance(uring_.br, uring_nbuf);
+
+  uring_.efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (uring_.efd == -1) {
+    std::cerr << "eventfd: " << strerror(errno) << std::endl;
     return -1;
   }
 
-  buf.push(nwrite);
+  if (auto rv = io_uring_register_eventfd(&uring_.ring, uring_.efd); rv < 0) {
+    std::cerr << "io_uring_register_eventfd: " << strerror(-rv) << std::endl;
+    return -1;
+  }
 
-  ngtcp2_addr laddr{
-      const_cast<sockaddr *>(&local_addr.su.sa),
-      local_addr.len,
-  };
-  ngtcp2_addr raddr{
-      const_cast<sockaddr *>(sa),
-      salen,
-  };
+  ev_io_set(&uring_.rev, uring_.efd, EV_READ);
+  ev_io_start(loop_, &uring_.rev);
 
-  if (send_packet(ep, laddr, raddr, /* ecn = */ 0, buf.rpos(), buf.size()) !=
-      NETWORK_ERR_OK) {
+  for (size_t i = 0; i < endpoints_.size(); ++i) {
+    uring_arm_recv(i);
+  }
+
+  if (auto rv = io_uring_submit(&uring_.ring); rv < 0) {
+    std::cerr << "io_uring_submit: " << strerror(-rv) << std::endl;
     return -1;
   }
 
   return 0;
 }
 
-int Server::send_retry(const ngtcp2_pkt_hd *chd, Endpoint &ep,
-                       const Address &local_addr, const sockaddr *sa,
-                       socklen_t salen, size_t max_pktlen) {
-  std::array<char, NI_MAXHOST> host;
-  std::array<char, NI_MAXSERV> port;
-
-  if (auto rv = getnameinfo(sa, salen, host.data(), host.size(), port.data(),
-                            port.size(), NI_NUMERICHOST | NI_NUMERICSERV);
-      rv != 0) {
-    std::cerr << "getnameinfo: " << gai_strerror(rv) << std::endl;
-    return -1;
+void Server::uring_arm_recv(size_t epidx) {
+  auto sqe = io_uring_get_sqe(&uring_.ring);
+  if (!sqe) {
+    io_uring_submit(&uring_.ring);
+    sqe = io_uring_get_sqe(&uring_.ring);
   }
 
-  if (!config.quiet) {
-    std::cerr << "Sending Retry packet to [" << host.data()
-              << "]:" << port.data() << std::endl;
-  }
+  assert(sqe);
 
-  ngtcp2_cid scid;
+  io_uring_prep_recvmsg_multishot(sqe, endpoints_[epidx].fd, &uring_.msg, 0);
+  sqe->flags |= IOSQE_BUFFER_SELECT;
+  sqe->buf_group = uring_bgid;
+  io_uring_sqe_set_data64(sqe, uring_op_recv << 32 | epidx);
+}
 
-  scid.datalen = NGTCP2_SV_SCIDLEN;
-  if (util::generate_secure_random(scid.data, scid.datalen) != 0) {
-    return -1;
+void Server::on_uring_read() {
+  uint64_t n;
+
+  while (read(uring_.efd, &n, sizeof(n)) == -1 && errno == EINTR)
+    ;
+
+  if (!uring_.cqes.empty()) {
+    auto cqes = std::move(uring_.cqes);
+    uring_.cqes.clear();
+
+    for (auto &c : cqes) {
+      uring_handle_cqe(c.user_data, c.res, c.flags);
+    }
   }
 
-  std::array<uint8_t, NGTCP2_CRYPTO_MAX_RETRY_TOKENLEN> token;
+  for (;;) {
+    io_uring_cqe *cqe;
 
-  auto t = std::chrono::duration_cast<std::chrono::nanoseconds>(
-               std::chrono::system_clock::now().time_since_epoch())
-               .count();
+    if (io_uring_peek_cqe(&uring_.ring, &cqe) != 0) {
+      break;
+    }
 
-  auto tokenlen = ngtcp2_crypto_generate_retry_token(
-      token.data(), config.static_secret.data(), config.static_secret.size(),
-      chd->version, sa, salen, &scid, &chd->dcid, t);
-  if (tokenlen < 0) {
-    return -1;
+    auto user_data = io_uring_cqe_get_data64(cqe);
+    auto res = cqe->res;
+    auto flags = cqe->flags;
+
+    io_uring_cqe_seen(&uring_.ring, cqe);
+
+    uring_handle_cqe(user_data, res, flags);
   }
 
-  if (!config.quiet) {
-    std::cerr << "Generated address validation token:" << std::endl;
-    util::hexdump(stderr, token.data(), tokenlen);
+  io_uring_submit(&uring_.ring);
+}
+
+void Server::uring_handle_cqe(uint64_t user_data, int32_t res,
+                              uint32_t flags) {
+  if ((user_data >> 32) != uring_op_recv) {
+    return;
   }
 
-  Buffer buf{
-      std::min(static_cast<size_t>(NGTCP2_MAX_UDP_PAYLOAD_SIZE), max_pktlen)};
+  auto epidx = static_cast<size_t>(user_data & 0xffffffffu);
+  auto &ep = endpoints_[epidx];
 
-  auto nwrite = ngtcp2_crypto_write_retry(buf.wpos(), buf.left(), chd->version,
-                                          &chd->scid, &scid, &chd->dcid,
-                                          token.data(), tokenlen);
-  if (nwrite < 0) {
-    std::cerr << "ngtcp2_crypto_write_retry failed" << std::endl;
-    return -1;
+  if (!(flags & IORING_CQE_F_MORE)) {
+    // Multishot recvmsg has terminated (e.g., the buffer ring was
+    // exhausted).
+    uring_arm_recv(epidx);
   }
 
-  buf.push(nwrite);
+  if (res < 0) {
+    if (res != -ENOBUFS) {
+      std::cerr << "recvmsg: " << strerror(-res) << std::endl;
+    }
+    return;
+  }
 
-  ngtcp2_addr laddr{
-      const_cast<sockaddr *>(&local_addr.su.sa),
-      local_addr.len,
-  };
-  ngtcp2_addr raddr{
-      const_cast<sockaddr *>(sa),
-      salen,
-  };
+  assert(flags & IORING_CQE_F_BUFFER);
 
-  if (send_packet(ep, laddr, raddr, /* ecn = */ 0, buf.rpos(), buf.size()) !=
-      NETWORK_ERR_OK) {
-    return -1;
+  auto bid = flags >> IORING_CQE_BUFFER_SHIFT;
+  auto buf = uring_.bufs.get() + bid * uring_.bufsize;
+
+  if (auto out = io_uring_recvmsg_validate(buf, res, &uring_.msg);
+      out && !(out->flags & MSG_TRUNC)) {
+    msghdr msg{};
+    msg.msg_name = io_uring_recvmsg_name(out);
+    msg.msg_namelen = out->namelen;
+    msg.msg_control =
+        static_cast<uint8_t *>(msg.msg_name) + uring_.msg.msg_namelen;
+    msg.msg_controllen = out->controllen;
+
+    ++rx_stats_.ndgram;
+
+    // The payload is passed to the connection without copying it
+    // out of the buffer ring.
+    auto payload =
+        static_cast<uint8_t *>(io_uring_recvmsg_payload(out, &uring_.msg));
+    auto payloadlen = io_uring_recvmsg_payload_length(out, res, &uring_.msg);
+
+    on_read_msg(ep, &msg, payload, payloadlen);
+
+    flush_proxy_tx();
   }
 
-  return 0;
+  io_uring_buf_ring_add(uring_.br, buf, uring_.bufsize, bid,
+                        io_uring_buf_ring_mask(uring_nbuf), 0);
+  io_uring_buf_ring_advance(uring_.br, 1);
 }
 
-int Server::send_stateless_connection_close(const ngtcp2_pkt_hd *chd,
-                                            Endpoint &ep,
-                                            const Address &local_addr,
-                                            const sockaddr *sa,
-                                            socklen_t salen) {
-  Buffer buf{NGTCP2_MAX_UDP_PAYLOAD_SIZE};
-
-  auto nwrite = ngtcp2_crypto_write_connection_close(
-      buf.wpos(), buf.left(), chd->version, &chd->scid, &chd->dcid,
-      NGTCP2_INVALID_TOKEN, nullptr, 0);
-  if (nwrite < 0) {
-    std::cerr << "ngtcp2_crypto_write_connection_close failed" << std::endl;
-    return -1;
+void Server::uring_free() {
+  if (!uring_.initialized) {
+    return;
   }
 
-  buf.push(nwrite);
+  ev_io_stop(loop_, &uring_.rev);
 
-  ngtcp2_addr laddr{
-      const_cast<sockaddr *>(&local_addr.su.sa),
-      local_addr.len,
-  };
-  ngtcp2_addr raddr{
-      const_cast<sockaddr *>(sa),
-      salen,
-  };
+  if (uring_.br) {
+    io_uring_free_buf_ring(&uring_.ring, uring_.br, uring_nbuf, uring_bgid);
+    uring_.br = nullptr;
+  }
 
-  if (send_packet(ep, laddr, raddr, /* ecn = */ 0, buf.rpos(), buf.size()) !=
-      NETWORK_ERR_OK) {
-    return -1;
+  io_uring_queue_exit(&uring_.ring);
+
+  if (uring_.efd != -1) {
+    ::close(uring_.efd);
+    uring_.efd = -1;
   }
 
-  return 0;
+  uring_.initialized = false;
 }
+#endif // HAVE_LIBURING
 
-int Server::verify_retry_token(ngtcp2_cid *ocid, const ngtcp2_pkt_hd *hd,
-                               const sockaddr *sa, socklen_t salen) {
-  std::array<char, NI_MAXHOST> host;
-  std::array<char, NI_MAXSERV> port;
+#ifdef HAVE_LIBBPF
+int Server::xdp_init(const XdpProgram &prog) {
+  auto sock = std::make_unique<XdpSocket>();
 
-  if (auto rv = getnameinfo(sa, salen, host.data(), host.size(), port.data(),
-                            port.size(), NI_NUMERICHOST | NI_NUMERICSERV);
-      rv != 0) {
-    std::cerr << "getnameinfo: " << gai_strerror(rv) << std::endl;
+  if (sock->init(prog, config.xdp_queue + worker_id_) != 0) {
     return -1;
   }
 
-  if (!config.quiet) {
-    std::cerr << "Verifying Retry token from [" << host.data()
-              << "]:" << port.data() << std::endl;
-    util::hexdump(stderr, hd->token.base, hd->token.len);
-  }
+  xdp_.sock = std::move(sock);
 
-  auto t = std::chrono::duration_cast<std::chrono::nanoseconds>(
-               std::chrono::system_clock::now().time_since_epoch())
-               .count();
+  ev_io_set(&xdp_.rev, xdp_.sock->fd(), EV_READ);
+  ev_io_start(loop_, &xdp_.rev);
 
-  if (ngtcp2_crypto_verify_retry_token(
-          ocid, hd->token.base, hd->token.len, config.static_secret.data(),
-          config.static_secret.size(), hd->version, sa, salen, &hd->dcid,
-          10 * NGTCP2_SECONDS, t) != 0) {
-    std::cerr << "Could not verify Retry token" << std::endl;
+  return 0;
+}
 
-    return -1;
-  }
+void Server::on_xdp_read() {
+  ++rx_stats_.ncall;
 
-  if (!config.quiet) {
-    std::cerr << "Token was successfully validated" << std::endl;
-  }
+  xdp_.sock->read(
+      [this](const xdp::FrameInfo &fi, uint8_t *data) {
+        read_frame(fi, data);
+      },
+      /* max = */ 64);
+}
+#endif // HAVE_LIBBPF
+
+#ifdef HAVE_LIBDPDK
+int Server::dpdk_init(const DpdkPort &port) {
+  dpdk_.queue = std::make_unique<DpdkQueue>(port, worker_id_);
+
+  ev_idle_start(loop_, &dpdk_.idle);
 
   return 0;
 }
 
-int Server::verify_token(const ngtcp2_pkt_hd *hd, const sockaddr *sa,
-                         socklen_t salen) {
-  std::array<char, NI_MAXHOST> host;
-  std::array<char, NI_MAXSERV> port;
-
-  if (auto rv = getnameinfo(sa, salen, host.data(), host.size(), port.data(),
-                            port.size(), NI_NUMERICHOST | NI_NUMERICSERV);
-      rv != 0) {
-    std::cerr << "getnameinfo: " << gai_strerror(rv) << std::endl;
-    return -1;
+void Server::on_dpdk_poll() {
+  if (dpdk_.queue->read(
+          [this](const xdp::FrameInfo &fi, uint8_t *data) {
+            read_frame(fi, data);
+          },
+          /* max = */ 64)) {
+    ++rx_stats_.ncall;
   }
+}
+#endif // HAVE_LIBDPDK
+
+void Server::read_frame(const xdp::FrameInfo &fi, uint8_t *data) {
+  auto family = fi.local_addr.su.sa.sa_family;
+  auto it = std::find_if(std::begin(endpoints_), std::end(endpoints_),
+                         [family](const Endpoint &ep) {
+                           return !ep.worker_only &&
+                                  ep.addr.su.sa.sa_family == family;
+                         });
+  if (it == std::end(endpoints_)) {
+    return;
+  }
+
+  ++rx_stats_.ndgram;
+  ++rx_stats_.nseg;
+
+  metrics_->on_rx(fi.payloadlen, fi.payloadlen);
 
   if (!config.quiet) {
-    std::cerr << "Verifying token from [" << host.data() << "]:" << port.data()
-              << std::endl;
-    util::hexdump(stderr, hd->token.base, hd->token.len);
+    std::cerr << "Received packet: local="
+              << util::straddr(&fi.local_addr.su.sa, fi.local_addr.len)
+              << " remote="
+              << util::straddr(&fi.remote_addr.su.sa, fi.remote_addr.len)
+              << " ecn=0x" << std::hex << fi.ecn << std::dec << " "
+              << fi.payloadlen << " bytes" << std::endl;
   }
 
-  auto t = std::chrono::duration_cast<std::chrono::nanoseconds>(
-               std::chrono::system_clock::now().time_since_epoch())
-               .count();
-
-  if (ngtcp2_crypto_verify_regular_token(hd->token.base, hd->token.len,
-                                         config.static_secret.data(),
-                                         config.static_secret.size(), sa, salen,
-                                         3600 * NGTCP2_SECONDS, t) != 0) {
+  if (debug::packet_lost(config.rx_loss_prob)) {
     if (!config.quiet) {
-      std::cerr << "Could not verify token" << std::endl;
+      std::cerr << "** Simulated incoming packet loss **" << std::endl;
     }
-    return -1;
+    return;
   }
 
-  if (!config.quiet) {
-    std::cerr << "Token was successfully validated" << std::endl;
+  if (fi.payloadlen == 0) {
+    return;
   }
 
-  return 0;
+  ngtcp2_pkt_info pi{};
+  pi.ecn = fi.ecn;
+
+  read_pkt(*it, fi.local_addr, &fi.remote_addr.su.sa, fi.remote_addr.len, &pi,
+           data, fi.payloadlen);
+
+  // The frame is returned to the datapath after this function
+  // returns.
+  flush_proxy_tx();
 }
 
-int Server::send_packet(Endpoint &ep, const ngtcp2_addr &local_addr,
-                        const ngtcp2_addr &remote_addr, unsigned int ecn,
-                        const uint8_t *data, size_t datalen) {
-  auto no_gso = false;
-  auto [_, rv] = send_packet(ep, no_gso, local_addr, remote_addr, ecn, data,
-                             datalen, datalen);
+void Server::on_read_msg(Endpoint &ep, msghdr *msg, uint8_t *data,
+                         size_t datalen) {
+  RecvInfo ri;
+  ngtcp2_pkt_info pi{};
 
-  return rv;
+  msghdr_get_recv_info(ri, msg);
+
+  on_rxq_drops(ep, ri.drops);
+
+  pi.ecn = ri.ecn;
+
+  on_read_dgram(ep, static_cast<const sockaddr *>(msg->msg_name),
+                msg->msg_namelen, pi, ri.local_addr, ri.gso_size, data,
+                datalen);
 }
 
-std::pair<size_t, int>
-Server::send_packet(Endpoint &ep, bool &no_gso, const ngtcp2_addr &local_addr,
-                    const ngtcp2_addr &remote_addr, unsigned int ecn,
-                    const uint8_t *data, size_t datalen, size_t gso_size) {
-  assert(gso_size);
+void Server::on_read_dgram(Endpoint &ep, const sockaddr *sa, socklen_t salen,
+                           const ngtcp2_pkt_info &pi, Address local_addr,
+                           size_t gso_size, uint8_t *data, size_t datalen) {
+  if (local_addr.len == 0) {
+    std::cerr << "Unable to obtain local address" << std::endl;
+    return;
+  }
 
-  if (debug::packet_lost(config.tx_loss_prob)) {
-    if (!config.quiet) {
-      std::cerr << "** Simulated outgoing packet loss **" << std::endl;
+  set_port(local_addr, ep.addr);
+
+  if (gso_size == 0) {
+    gso_size = datalen;
+  }
+
+  metrics_->on_rx(datalen, gso_size);
+
+  if (gso_size < datalen) {
+    prepare_rx_hp_masks(data, datalen, gso_size);
+
+    // Without per-segment logging and simulated loss, the segments of
+    // an established connection are read in one call.
+    if (config.quiet && config.rx_loss_prob == 0 &&
+        read_pkts(ep, local_addr, sa, salen, &pi, data, datalen, gso_size)) {
+      return;
     }
-    return {0, NETWORK_ERR_OK};
   }
 
-  if (no_gso && datalen > gso_size) {
-    size_t nsent = 0;
+  // Each segment of UDP_GRO coalesced datagrams is processed as if it
+  // was received separately.
+  for (auto end = data + datalen;;) {
+    auto len = std::min(gso_size, static_cast<size_t>(end - data));
 
-    for (auto p = data; p < data + datalen; p += gso_size) {
-      auto len = std::min(gso_size, static_cast<size_t>(data + datalen - p));
+    ++rx_stats_.nseg;
 
-      auto [n, rv] =
-          send_packet(ep, no_gso, local_addr, remote_addr, ecn, p, len, len);
-      if (rv != 0) {
-        return {nsent, rv};
+    if (!config.quiet) {
+      std::array<char, IF_NAMESIZE> ifname;
+      std::cerr << "Received packet: local="
+                << util::straddr(&local_addr.su.sa, local_addr.len)
+                << " remote=" << util::straddr(sa, salen)
+                << " if=" << if_indextoname(local_addr.ifindex, ifname.data())
+                << " ecn=0x" << std::hex << pi.ecn << std::dec << " " << len
+                << " bytes" << std::endl;
+    }
+
+    if (debug::packet_lost(config.rx_loss_prob)) {
+      if (!config.quiet) {
+        std::cerr << "** Simulated incoming packet loss **" << std::endl;
       }
+    } else if (len) {
+      read_pkt(ep, local_addr, sa, salen, &pi, data, len);
+    }
 
-      nsent += n;
+    data += len;
+    if (data == end) {
+      return;
     }
+  }
+}
 
-    return {nsent, 0};
+void Server::on_rxq_drops(Endpoint &ep, uint32_t drops) {
+  if (drops == 0 || drops == ep.rxq_drops) {
+    return;
   }
 
-  iovec msg_iov;
-  msg_iov.iov_base = const_cast<uint8_t *>(data);
-  msg_iov.iov_len = datalen;
+  // The counter wraps around.
+  auto n = static_cast<uint32_t>(drops - ep.rxq_drops);
 
-  msghdr msg{};
-  msg.msg_name = const_cast<sockaddr *>(remote_addr.addr);
-  msg.msg_namelen = remote_addr.addrlen;
-  msg.msg_iov = &msg_iov;
-  msg.msg_iovlen = 1;
+  ep.rxq_drops = drops;
+
+  rx_stats_.ndrop += n;
+  metrics_->rx_kernel_drops.add(n);
 
-  uint8_t
-      msg_ctrl[CMSG_SPACE(sizeof(uint16_t)) + CMSG_SPACE(sizeof(in6_pktinfo))];
+  if (!config.quiet) {
+    std::cerr << "** Kernel dropped " << n
+              << " datagrams: socket receive buffer is full **" << std::endl;
+  }
+}
 
-  memset(msg_ctrl, 0, sizeof(msg_ctrl));
+void Server::prepare_rx_hp_masks(const uint8_t *data, size_t datalen,
+                                 size_t gso_size) {
+  ngtcp2_version_cid vc;
 
-  msg.msg_control = msg_ctrl;
-  msg.msg_controllen = sizeof(msg_ctrl);
+  if (ngtcp2_pkt_decode_version_cid(&vc, data, datalen, NGTCP2_SV_SCIDLEN) !=
+      0) {
+    return;
+  }
 
-  size_t controllen = 0;
+  auto ph = handlers_.find(vc.dcid, vc.dcidlen);
+  if (!ph) {
+    return;
+  }
 
-  auto cm = CMSG_FIRSTHDR(&msg);
+  // UDP_GRO coalesces the datagrams from the same 4-tuple, which
+  // typically belong to the same connection.  ngtcp2 ignores the
+  // masks of datagrams destined to the other connections.
+  std::array<ngtcp2_vec, 64> pktv;
+  size_t pktvcnt = 0;
 
-  switch (local_addr.addr->sa_family) {
-  case AF_INET: {
-    controllen += CMSG_SPACE(sizeof(in_pktinfo));
-    cm->cmsg_level = IPPROTO_IP;
-    cm->cmsg_type = IP_PKTINFO;
-    cm->cmsg_len = CMSG_LEN(sizeof(in_pktinfo));
-    auto pktinfo = reinterpret_cast<in_pktinfo *>(CMSG_DATA(cm));
-    memset(pktinfo, 0, sizeof(in_pktinfo));
-    auto addrin = reinterpret_cast<sockaddr_in *>(local_addr.addr);
-    pktinfo->ipi_spec_dst = addrin->sin_addr;
-    break;
+  for (auto end = data + datalen; data != end && pktvcnt < pktv.size();) {
+    auto len = std::min(gso_size, static_cast<size_t>(end - data));
+    pktv[pktvcnt++] = {const_cast<uint8_t *>(data), len};
+    data += len;
   }
-  case AF_INET6: {
-    controllen += CMSG_SPACE(sizeof(in6_pktinfo));
-    cm->cmsg_level = IPPROTO_IPV6;
-    cm->cmsg_type = IPV6_PKTINFO;
-    cm->cmsg_len = CMSG_LEN(sizeof(in6_pktinfo));
-    auto pktinfo = reinterpret_cast<in6_pktinfo *>(CMSG_DATA(cm));
-    memset(pktinfo, 0, sizeof(in6_pktinfo));
-    auto addrin = reinterpret_cast<sockaddr_in6 *>(local_addr.addr);
-    pktinfo->ipi6_addr = addrin->sin6_addr;
+
+  (*ph)->prepare_rx_hp_masks(pktv.data(), pktvcnt);
+}
+
+void Server::read_pkt(Endpoint &ep, const Address &local_addr,
+                      const sockaddr *sa, socklen_t salen,
+                      const ngtcp2_pkt_info *pi, uint8_t *data,
+                      size_t datalen) {
+  ngtcp2_pkt_hd hd;
+  ngtcp2_version_cid vc;
+
+  switch (auto rv = ngtcp2_pkt_decode_version_cid(&vc, data, datalen,
+                                                  NGTCP2_SV_SCIDLEN);
+          rv) {
+  case 0:
     break;
-  }
+  case NGTCP2_ERR_VERSION_NEGOTIATION:
+    send_version_negotiation(vc.version, vc.scid, vc.scidlen, vc.dcid,
+                             vc.dcidlen, ep, local_addr, sa, salen);
+    return;
   default:
-    assert(0);
+    std::cerr << "Could not decode version and CID from QUIC packet header: "
+              << ngtcp2_strerror(rv) << std::endl;
+    return;
   }
 
-#ifdef UDP_SEGMENT
-  if (datalen > gso_size) {
-    controllen += CMSG_SPACE(sizeof(uint16_t));
-    cm = CMSG_NXTHDR(&msg, cm);
-    cm->cmsg_level = SOL_UDP;
-    cm->cmsg_type = UDP_SEGMENT;
-    cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
-    *(reinterpret_cast<uint16_t *>(CMSG_DATA(cm))) = gso_size;
+  auto ph = handlers_.find(vc.dcid, vc.dcidlen);
+  if (!ph && !(data[0] & 0x80)) {
+    // Stateless Reset from client has a random Connection ID.  It is
+    // recognized by the token at its end instead.
+    ph = find_reset_token(data, datalen);
   }
-#endif // UDP_SEGMENT
+  if (!ph) {
+    if (auto pt = tombstones_.cids.find(vc.dcid, vc.dcidlen); pt) {
+      auto t = *pt;
 
-  msg.msg_controllen = controllen;
+      if (t->closebuf.empty()) {
+        // Draining period
+        return;
+      }
 
-  if (ep.ecn != ecn) {
-    ep.ecn = ecn;
-    fd_set_ecn(ep.fd, ep.addr.su.storage.ss_family, ecn);
-  }
+      if (!config.quiet) {
+        std::cerr << "Closing Period: TX CONNECTION_CLOSE" << std::endl;
+      }
 
-  ssize_t nwrite = 0;
+      ngtcp2_addr laddr{
+          &t->local_addr.su.sa,
+          t->local_addr.len,
+      };
+      ngtcp2_addr raddr{
+          &t->remote_addr.su.sa,
+          t->remote_addr.len,
+      };
 
-  do {
-    nwrite = sendmsg(ep.fd, &msg, 0);
-  } while (nwrite == -1 && errno == EINTR);
+      // TODO do exponential backoff.
+      send_packet(*t->ep, laddr, raddr, /* ecn = */ 0, t->closebuf.data(),
+                  t->closebuf.size());
 
-  if (nwrite == -1) {
-    switch (errno) {
-    case EAGAIN:
-#if EAGAIN != EWOULDBLOCK
-    case EWOULDBLOCK:
-#endif // EAGAIN != EWOULDBLOCK
-      return {0, NETWORK_ERR_SEND_BLOCKED};
-#ifdef UDP_SEGMENT
-    case EIO:
-      if (datalen > gso_size) {
-        // GSO failure; send each packet in a separate sendmsg call.
-        std::cerr << "sendmsg: disabling GSO due to " << strerror(errno)
-                  << std::endl;
+      return;
+    }
 
-        no_gso = true;
+    // A short header packet for an unknown connection is most likely
+    // for the connection which this server has forgotten, e.g., after
+    // restart.  Answer it with Stateless Reset without decoding the
+    // rest of the header.
+    if (!(data[0] & 0x80)) {
+      send_stateless_reset(datalen, vc.dcid, vc.dcidlen, ep, local_addr, sa,
+                           salen);
+      return;
+    }
 
-        return send_packet(ep, no_gso, local_addr, remote_addr, ecn, data,
-                           datalen, gso_size);
-      }
+    switch (auto rv = ngtcp2_accept(&hd, data, datalen); rv) {
+    case 0:
       break;
-#endif // UDP_SEGMENT
+    case NGTCP2_ERR_RETRY:
+      send_retry(&hd, ep, local_addr, sa, salen, datalen * 3);
+      return;
+    default:
+      if (!config.quiet) {
+        std::cerr << "Unexpected packet received: length=" << datalen
+                  << std::endl;
+      }
+      return;
     }
 
-    std::cerr << "sendmsg: " << strerror(errno) << std::endl;
-    // TODO We have packet which is expected to fail to send (e.g.,
-    // path validation to old path).
-    return {0, NETWORK_ERR_OK};
-  }
+    ngtcp2_cid ocid;
+    ngtcp2_cid *pocid = nullptr;
+    ngtcp2_cc_resume_params cc_resume{};
 
-  if (!config.quiet) {
-    std::cerr << "Sent packet: local="
-              << util::straddr(local_addr.addr, local_addr.addrlen)
-              << " remote="
-              << util::straddr(remote_addr.addr, remote_addr.addrlen)
-              << " ecn=0x" << std::hex << ecn << std::dec << " " << nwrite
-              << " bytes" << std::endl;
-  }
+    assert(hd.type == NGTCP2_PKT_INITIAL);
 
-  return {nwrite, NETWORK_ERR_OK};
-}
+    // The admission check is done only if a client does not present a
+    // valid token so that it does not consume the budget of the
+    // clients which have validated their address.
+    auto retry_required = [this, sa]() {
+      return config.validate_addr || need_retry(sa);
+    };
 
-void Server::associate_cid(const ngtcp2_cid *cid, Handler *h) {
-  handlers_.emplace(util::make_cid_key(cid), h);
-}
+    if (hd.token.len == 0 && retry_required()) {
+      send_retry(&hd, ep, local_addr, sa, salen, datalen * 3);
+      return;
+    }
 
-void Server::dissociate_cid(const ngtcp2_cid *cid) {
-  handlers_.erase(util::make_cid_key(cid));
-}
+    if (hd.token.len) {
+      std::cerr << "Perform stateless address validation" << std::endl;
 
-void Server::remove(const Handler *h) {
-  auto conn = h->conn();
+      if (hd.token.base[0] != NGTCP2_CRYPTO_TOKEN_MAGIC_RETRY &&
+          hd.dcid.datalen < NGTCP2_MIN_INITIAL_DCIDLEN) {
+        send_stateless_connection_close(&hd, ep, local_addr, sa, salen);
+        return;
+      }
 
-  handlers_.erase(
-      util::make_cid_key(ngtcp2_conn_get_client_initial_dcid(conn)));
+      switch (hd.token.base[0]) {
+      case NGTCP2_CRYPTO_TOKEN_MAGIC_RETRY:
+        if (verify_retry_token(&ocid, &hd, sa, salen) != 0) {
+          send_stateless_connection_close(&hd, ep, local_addr, sa, salen);
+          return;
+        }
+        pocid = &ocid;
+        break;
+      case NGTCP2_CRYPTO_TOKEN_MAGIC_REGULAR:
+        if (verify_token(&cc_resume, &hd, sa, salen) != 0) {
+          if (retry_required()) {
+            send_retry(&hd, ep, local_addr, sa, salen, datalen * 3);
+            return;
+          }
 
-  std::vector<ngtcp2_cid> cids(ngtcp2_conn_get_num_scid(conn));
-  ngtcp2_conn_get_scid(conn, cids.data());
+          hd.token.base = nullptr;
+          hd.token.len = 0;
+        }
+        break;
+      default:
+        if (!config.quiet) {
+          std::cerr << "Ignore unrecognized token" << std::endl;
+        }
+        if (retry_required()) {
+          send_retry(&hd, ep, local_addr, sa, salen, datalen * 3);
+          return;
+        }
+
+        hd.token.base = nullptr;
+        hd.token.len = 0;
+        break;
+      }
+    }
+
+    auto h = std::make_unique<Handler>(loop_, this);
+    if (h->init(ep, local_addr, sa, salen, &hd.scid, &hd.dcid, pocid,
+                hd.token.base, hd.token.len, cc_resume, hd.version,
+                tls_ctx_) != 0) {
+      return;
+    }
+
+    h->set_half_open();
+
+    switch (h->on_read(ep, local_addr, sa, salen, pi, data, datalen, datalen)) {
+    case 0:
+      break;
+    case NETWORK_ERR_RETRY:
+      send_retry(&hd, ep, local_addr, sa, salen, datalen * 3);
+      return;
+    default:
+      return;
+    }
+
+    switch (h->on_write()) {
+    case 0:
+      break;
+    default:
+      return;
+    }
+
+    std::array<ngtcp2_cid, 2> scids;
+    auto conn = h->conn();
+
+    auto num_scid = ngtcp2_conn_get_num_scid(conn);
+
+    assert(num_scid <= scids.size());
+
+    ngtcp2_conn_get_scid(conn, scids.data());
+
+    for (size_t i = 0; i < num_scid; ++i) {
+      handlers_.emplace(&scids[i], h.get());
+    }
+
+    handlers_.emplace(vc.dcid, vc.dcidlen, h.get());
+
+    h.release();
+
+    return;
+  }
+
+  auto h = *ph;
+
+  if (auto rv =
+          h->on_read(ep, local_addr, sa, salen, pi, data, datalen, datalen);
+      rv != 0) {
+    if (rv == NETWORK_ERR_CLOSE_WAIT) {
+      add_tombstone(h);
+    } else {
+      remove(h);
+    }
+    return;
+  }
+
+  h->signal_write();
+}
+
+bool Server::read_pkts(Endpoint &ep, const Address &local_addr,
+                       const sockaddr *sa, socklen_t salen,
+                       const ngtcp2_pkt_info *pi, uint8_t *data,
+                       size_t datalen, size_t gso_size) {
+  if (gso_size < 1 + NGTCP2_SV_SCIDLEN) {
+    return false;
+  }
+
+  auto end = data + datalen;
+  size_t nseg = 0;
+
+  for (auto p = data; p != end; ++nseg) {
+    auto len = std::min(gso_size, static_cast<size_t>(end - p));
+    if (len < 1 + NGTCP2_SV_SCIDLEN || (p[0] & 0x80) ||
+        memcmp(p + 1, data + 1, NGTCP2_SV_SCIDLEN) != 0) {
+      return false;
+    }
+
+    p += len;
+  }
+
+  auto ph = handlers_.find(data + 1, NGTCP2_SV_SCIDLEN);
+  if (!ph) {
+    return false;
+  }
+
+  auto h = *ph;
+
+  rx_stats_.nseg += nseg;
+
+  if (auto rv =
+          h->on_read(ep, local_addr, sa, salen, pi, data, datalen, gso_size);
+      rv != 0) {
+    if (rv == NETWORK_ERR_CLOSE_WAIT) {
+      add_tombstone(h);
+    } else {
+      remove(h);
+    }
+    return true;
+  }
+
+  h->signal_write();
+
+  return true;
+}
+
+namespace {
+uint32_t generate_reserved_version(const sockaddr *sa, socklen_t salen,
+                                   uint32_t version) {
+  uint32_t h = 0x811C9DC5u;
+  const uint8_t *p = (const uint8_t *)sa;
+  const uint8_t *ep = p + salen;
+  for (; p != ep; ++p) {
+    h ^= *p;
+    h *= 0x01000193u;
+  }
+  version = htonl(version);
+  p = (const uint8_t *)&version;
+  ep = p + sizeof(version);
+  for (; p != ep; ++p) {
+    h ^= *p;
+    h *= 0x01000193u;
+  }
+  h &= 0xf0f0f0f0u;
+  h |= 0x0a0a0a0au;
+  return h;
+}
+} // namespace
+
+int Server::send_version_negotiation(uint32_t version, const uint8_t *dcid,
+                                     size_t dcidlen, const uint8_t *scid,
+                                     size_t scidlen, Endpoint &ep,
+                                     const Address &local_addr,
+                                     const sockaddr *sa, socklen_t salen) {
+  std::array<uint8_t, NGTCP2_MAX_UDP_PAYLOAD_SIZE> buf;
+
+  // Only the reserved version depends on the packet.  The rest of
+  // vn_sv_ is prepared in init.
+  vn_sv_[0] = generate_reserved_version(sa, salen, version);
+
+  auto nwrite = ngtcp2_pkt_write_version_negotiation(
+      buf.data(), buf.size(),
+      std::uniform_int_distribution<uint8_t>(
+          0, std::numeric_limits<uint8_t>::max())(randgen),
+      dcid, dcidlen, scid, scidlen, vn_sv_.data(), vn_svlen_);
+  if (nwrite < 0) {
+    std::cerr << "ngtcp2_pkt_write_version_negotiation: "
+              << ngtcp2_strerror(nwrite) << std::endl;
+    return -1;
+  }
+
+  ngtcp2_addr laddr{
+      const_cast<sockaddr *>(&local_addr.su.sa),
+      local_addr.len,
+  };
+  ngtcp2_addr raddr{
+      const_cast<sockaddr *>(sa),
+      salen,
+  };
+
+  if (send_packet(ep, laddr, raddr, /* ecn = */ 0, buf.data(),
+                  static_cast<size_t>(nwrite)) != NETWORK_ERR_OK) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int Server::send_retry(const ngtcp2_pkt_hd *chd, Endpoint &ep,
+                       const Address &local_addr, const sockaddr *sa,
+                       socklen_t salen, size_t max_pktlen) {
+  if (!config.quiet) {
+    std::array<char, NI_MAXHOST> host;
+    std::array<char, NI_MAXSERV> port;
+
+    if (auto rv = getnameinfo(sa, salen, host.data(), host.size(),
+                              port.data(), port.size(),
+                              NI_NUMERICHOST | NI_NUMERICSERV);
+        rv != 0) {
+      std::cerr << "getnameinfo: " << gai_strerror(rv) << std::endl;
+      return -1;
+    }
+
+    std::cerr << "Sending Retry packet to [" << host.data()
+              << "]:" << port.data() << std::endl;
+  }
+
+  ngtcp2_cid scid;
+
+  scid.datalen = NGTCP2_SV_SCIDLEN;
+  if (generate_cid(scid.data, scid.datalen) != 0) {
+    return -1;
+  }
+
+  std::array<uint8_t, NGTCP2_CRYPTO_MAX_RETRY_TOKENLEN> token;
+
+  auto t = std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+               .count();
+
+  auto tokenlen = ngtcp2_crypto_token_ctx_generate_retry_token(
+      &token_ctx_, token.data(), chd->version, sa, salen, &scid, &chd->dcid, t);
+  if (tokenlen < 0) {
+    return -1;
+  }
+
+  if (!config.quiet) {
+    std::cerr << "Generated address validation token:" << std::endl;
+    util::hexdump(stderr, token.data(), tokenlen);
+  }
+
+  std::array<uint8_t, NGTCP2_MAX_UDP_PAYLOAD_SIZE> buf;
+
+  auto nwrite = ngtcp2_crypto_retry_ctx_write_retry(
+      &retry_ctx_, buf.data(), std::min(buf.size(), max_pktlen), chd->version,
+      &chd->scid, &scid, &chd->dcid, token.data(), tokenlen);
+  if (nwrite < 0) {
+    std::cerr << "ngtcp2_crypto_retry_ctx_write_retry failed" << std::endl;
+    return -1;
+  }
+
+  ngtcp2_addr laddr{
+      const_cast<sockaddr *>(&local_addr.su.sa),
+      local_addr.len,
+  };
+  ngtcp2_addr raddr{
+      const_cast<sockaddr *>(sa),
+      salen,
+  };
+
+  if (send_packet(ep, laddr, raddr, /* ecn = */ 0, buf.data(),
+                  static_cast<size_t>(nwrite)) != NETWORK_ERR_OK) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int Server::send_stateless_connection_close(const ngtcp2_pkt_hd *chd,
+                                            Endpoint &ep,
+                                            const Address &local_addr,
+                                            const sockaddr *sa,
+                                            socklen_t salen) {
+  Buffer buf{NGTCP2_MAX_UDP_PAYLOAD_SIZE};
+
+  auto nwrite = ngtcp2_crypto_write_connection_close_cached(
+      buf.wpos(), buf.left(), chd->version, &chd->scid, &chd->dcid,
+      NGTCP2_INVALID_TOKEN, nullptr, 0, &initial_key_cache_);
+  if (nwrite < 0) {
+    std::cerr << "ngtcp2_crypto_write_connection_close_cached failed"
+              << std::endl;
+    return -1;
+  }
+
+  buf.push(nwrite);
+
+  ngtcp2_addr laddr{
+      const_cast<sockaddr *>(&local_addr.su.sa),
+      local_addr.len,
+  };
+  ngtcp2_addr raddr{
+      const_cast<sockaddr *>(sa),
+      salen,
+  };
+
+  if (send_packet(ep, laddr, raddr, /* ecn = */ 0, buf.rpos(), buf.size()) !=
+      NETWORK_ERR_OK) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int Server::send_stateless_reset(size_t pktlen, const uint8_t *dcid,
+                                 size_t dcidlen, Endpoint &ep,
+                                 const Address &local_addr, const sockaddr *sa,
+                                 socklen_t salen) {
+  // As per RFC 9000 section 10.3, Stateless Reset must be smaller
+  // than the packet which triggers it so that 2 endpoints cannot
+  // loop forever.
+  constexpr size_t min_pktlen = 1 + NGTCP2_MIN_STATELESS_RESET_RANDLEN +
+                                NGTCP2_STATELESS_RESET_TOKENLEN + 1;
+  // Enough to look like a short header packet with
+  // NGTCP2_SV_SCIDLEN bytes Destination Connection ID.
+  constexpr size_t max_randlen = NGTCP2_SV_SCIDLEN + 22;
+
+  if (pktlen < min_pktlen) {
+    return 0;
+  }
+
+  auto now = util::timestamp(loop_);
+
+  if (stateless_reset_.budget < stateless_reset_burst) {
+    auto n = (now - stateless_reset_.last_ts) / stateless_reset_interval;
+    if (n) {
+      stateless_reset_.budget = static_cast<size_t>(std::min(
+          static_cast<uint64_t>(stateless_reset_burst),
+          stateless_reset_.budget + n));
+      stateless_reset_.last_ts = now;
+    }
+  } else {
+    stateless_reset_.last_ts = now;
+  }
+
+  if (stateless_reset_.budget == 0) {
+    if (!config.quiet) {
+      std::cerr << "Stateless Reset was suppressed" << std::endl;
+    }
+
+    return 0;
+  }
+
+  --stateless_reset_.budget;
+
+  ngtcp2_cid cid;
+  ngtcp2_cid_init(&cid, dcid, dcidlen);
+
+  std::array<uint8_t, NGTCP2_STATELESS_RESET_TOKENLEN> token;
+
+  if (ngtcp2_crypto_generate_stateless_reset_token(
+          token.data(), config.static_secret.data(),
+          config.static_secret.size(), &cid) != 0) {
+    return -1;
+  }
+
+  auto randlen =
+      std::min(max_randlen, pktlen - 1 - NGTCP2_STATELESS_RESET_TOKENLEN - 1);
+
+  std::array<uint8_t, max_randlen> rand;
+
+  if (util::generate_secure_random(rand.data(), randlen) != 0) {
+    return -1;
+  }
+
+  std::array<uint8_t, 1 + max_randlen + NGTCP2_STATELESS_RESET_TOKENLEN> buf;
+
+  auto nwrite = ngtcp2_pkt_write_stateless_reset(
+      buf.data(), buf.size(), token.data(), rand.data(), randlen);
+  if (nwrite < 0) {
+    std::cerr << "ngtcp2_pkt_write_stateless_reset: " << ngtcp2_strerror(nwrite)
+              << std::endl;
+    return -1;
+  }
+
+  if (!config.quiet) {
+    std::cerr << "Sending Stateless Reset: length=" << nwrite << std::endl;
+  }
+
+  ngtcp2_addr laddr{
+      const_cast<sockaddr *>(&local_addr.su.sa),
+      local_addr.len,
+  };
+  ngtcp2_addr raddr{
+      const_cast<sockaddr *>(sa),
+      salen,
+  };
+
+  if (send_packet(ep, laddr, raddr, /* ecn = */ 0, buf.data(), nwrite) !=
+      NETWORK_ERR_OK) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int Server::verify_retry_token(ngtcp2_cid *ocid, const ngtcp2_pkt_hd *hd,
+                               const sockaddr *sa, socklen_t salen) {
+  std::array<char, NI_MAXHOST> host;
+  std::array<char, NI_MAXSERV> port;
+
+  if (auto rv = getnameinfo(sa, salen, host.data(), host.size(), port.data(),
+                            port.size(), NI_NUMERICHOST | NI_NUMERICSERV);
+      rv != 0) {
+    std::cerr << "getnameinfo: " << gai_strerror(rv) << std::endl;
+    return -1;
+  }
+
+  if (!config.quiet) {
+    std::cerr << "Verifying Retry token from [" << host.data()
+              << "]:" << port.data() << std::endl;
+    util::hexdump(stderr, hd->token.base, hd->token.len);
+  }
+
+  auto t = std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+               .count();
+
+  if (ngtcp2_crypto_token_ctx_verify_retry_token(
+          &token_ctx_, ocid, hd->token.base, hd->token.len, hd->version, sa,
+          salen, &hd->dcid, 10 * NGTCP2_SECONDS, t) != 0) {
+    std::cerr << "Could not verify Retry token" << std::endl;
+
+    return -1;
+  }
+
+  if (!config.quiet) {
+    std::cerr << "Token was successfully validated" << std::endl;
+  }
+
+  return 0;
+}
+
+int Server::verify_token(ngtcp2_cc_resume_params *cc_resume,
+                         const ngtcp2_pkt_hd *hd, const sockaddr *sa,
+                         socklen_t salen) {
+  std::array<char, NI_MAXHOST> host;
+  std::array<char, NI_MAXSERV> port;
+
+  if (auto rv = getnameinfo(sa, salen, host.data(), host.size(), port.data(),
+                            port.size(), NI_NUMERICHOST | NI_NUMERICSERV);
+      rv != 0) {
+    std::cerr << "getnameinfo: " << gai_strerror(rv) << std::endl;
+    return -1;
+  }
+
+  if (!config.quiet) {
+    std::cerr << "Verifying token from [" << host.data() << "]:" << port.data()
+              << std::endl;
+    util::hexdump(stderr, hd->token.base, hd->token.len);
+  }
+
+  auto t = std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+               .count();
+
+  std::array<uint8_t, NGTCP2_CRYPTO_MAX_REGULAR_TOKEN_DATALEN> data;
+
+  auto datalen = ngtcp2_crypto_token_ctx_verify_regular_token2(
+      &token_ctx_, data.data(), data.size(), hd->token.base, hd->token.len,
+      sa, salen, 3600 * NGTCP2_SECONDS, t);
+  if (datalen < 0) {
+    if (!config.quiet) {
+      std::cerr << "Could not verify token" << std::endl;
+    }
+    return -1;
+  }
+
+  if (datalen &&
+      ngtcp2_decode_cc_resume_params(cc_resume, data.data(),
+                                     static_cast<size_t>(datalen)) == 0 &&
+      !config.quiet) {
+    std::cerr << "Token carries congestion control state: min_rtt="
+              << util::format_durationf(cc_resume->min_rtt)
+              << " cwnd=" << cc_resume->cwnd << std::endl;
+  }
+
+  if (!config.quiet) {
+    std::cerr << "Token was successfully validated" << std::endl;
+  }
+
+  return 0;
+}
+
+namespace {
+// tx_msg_ctrllen is the size of ancillary data buffer for a message
+// sent by sendmsg or sendmmsg.
+constexpr size_t tx_msg_ctrllen = CMSG_SPACE(sizeof(uint16_t)) +
+                                  CMSG_SPACE(sizeof(in6_pktinfo)) +
+                                  CMSG_SPACE(sizeof(uint64_t));
+} // namespace
+
+namespace {
+// msghdr_set_txinfo sets the source address |local_addr| and the GSO
+// segment size to |msg| using |ctrl| of length tx_msg_ctrllen as
+// ancillary data buffer.  If |txtime| is nonzero, it is set as the
+// earliest departure time of the message.
+void msghdr_set_txinfo(msghdr *msg, uint8_t *ctrl,
+                       const ngtcp2_addr &local_addr, size_t datalen,
+                       size_t gso_size, uint64_t txtime) {
+  memset(ctrl, 0, tx_msg_ctrllen);
+
+  msg->msg_control = ctrl;
+  msg->msg_controllen = tx_msg_ctrllen;
+
+  size_t controllen = 0;
+
+  auto cm = CMSG_FIRSTHDR(msg);
+
+  switch (local_addr.addr->sa_family) {
+  case AF_INET: {
+    controllen += CMSG_SPACE(sizeof(in_pktinfo));
+    cm->cmsg_level = IPPROTO_IP;
+    cm->cmsg_type = IP_PKTINFO;
+    cm->cmsg_len = CMSG_LEN(sizeof(in_pktinfo));
+    auto pktinfo = reinterpret_cast<in_pktinfo *>(CMSG_DATA(cm));
+    auto addrin = reinterpret_cast<sockaddr_in *>(local_addr.addr);
+    pktinfo->ipi_spec_dst = addrin->sin_addr;
+    break;
+  }
+  case AF_INET6: {
+    controllen += CMSG_SPACE(sizeof(in6_pktinfo));
+    cm->cmsg_level = IPPROTO_IPV6;
+    cm->cmsg_type = IPV6_PKTINFO;
+    cm->cmsg_len = CMSG_LEN(sizeof(in6_pktinfo));
+    auto pktinfo = reinterpret_cast<in6_pktinfo *>(CMSG_DATA(cm));
+    auto addrin = reinterpret_cast<sockaddr_in6 *>(local_addr.addr);
+    pktinfo->ipi6_addr = addrin->sin6_addr;
+    break;
+  }
+  default:
+    assert(0);
+  }
+
+#ifdef UDP_SEGMENT
+  if (datalen > gso_size) {
+    controllen += CMSG_SPACE(sizeof(uint16_t));
+    cm = CMSG_NXTHDR(msg, cm);
+    cm->cmsg_level = SOL_UDP;
+    cm->cmsg_type = UDP_SEGMENT;
+    cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    *(reinterpret_cast<uint16_t *>(CMSG_DATA(cm))) = gso_size;
+  }
+#endif // UDP_SEGMENT
+
+#ifdef SO_TXTIME
+  if (txtime) {
+    controllen += CMSG_SPACE(sizeof(uint64_t));
+    cm = CMSG_NXTHDR(msg, cm);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_TXTIME;
+    cm->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+    memcpy(CMSG_DATA(cm), &txtime, sizeof(txtime));
+  }
+#endif // SO_TXTIME
+
+  msg->msg_controllen = controllen;
+}
+} // namespace
+
+int Server::send_packet(Endpoint &ep, const ngtcp2_addr &local_addr,
+                        const ngtcp2_addr &remote_addr, unsigned int ecn,
+                        const uint8_t *data, size_t datalen) {
+  metrics_->on_tx(datalen, datalen);
+
+  auto no_gso = false;
+  auto [_, rv] = send_packet(ep, no_gso, local_addr, remote_addr, ecn, data,
+                             datalen, datalen, /* txtime = */ 0);
+
+  return rv;
+}
+
+namespace {
+// print_frame_sent prints the datagrams sent by AF_XDP or DPDK
+// datapath unless --quiet is given, and returns |res|.
+[[maybe_unused]] std::pair<size_t, int>
+print_frame_sent(const ngtcp2_addr &local_addr, const ngtcp2_addr &remote_addr,
+                 unsigned int ecn, std::pair<size_t, int> res) {
+  if (!config.quiet && res.first) {
+    std::cerr << "Sent packet: local="
+              << util::straddr(local_addr.addr, local_addr.addrlen)
+              << " remote="
+              << util::straddr(remote_addr.addr, remote_addr.addrlen)
+              << " ecn=0x" << std::hex << ecn << std::dec << " " << res.first
+              << " bytes" << std::endl;
+  }
+
+  return res;
+}
+} // namespace
+
+std::pair<size_t, int>
+Server::send_packet(Endpoint &ep, bool &no_gso, const ngtcp2_addr &local_addr,
+                    const ngtcp2_addr &remote_addr, unsigned int ecn,
+                    const uint8_t *data, size_t datalen, size_t gso_size,
+                    uint64_t txtime) {
+  if (netem_.link) {
+    netem_send(ep, local_addr, remote_addr, ecn, data, datalen, gso_size);
+
+    return {datalen, NETWORK_ERR_OK};
+  }
+
+  return send_packet_now(ep, no_gso, local_addr, remote_addr, ecn, data,
+                         datalen, gso_size, txtime);
+}
+
+std::pair<size_t, int>
+Server::send_packet_now(Endpoint &ep, bool &no_gso,
+                        const ngtcp2_addr &local_addr,
+                        const ngtcp2_addr &remote_addr, unsigned int ecn,
+                        const uint8_t *data, size_t datalen, size_t gso_size,
+                        uint64_t txtime) {
+  assert(gso_size);
+
+  if (debug::packet_lost(config.tx_loss_prob)) {
+    if (!config.quiet) {
+      std::cerr << "** Simulated outgoing packet loss **" << std::endl;
+    }
+    return {0, NETWORK_ERR_OK};
+  }
+
+#ifdef HAVE_LIBBPF
+  if (xdp_.sock) {
+    return print_frame_sent(local_addr, remote_addr, ecn,
+                            xdp_.sock->send(local_addr, remote_addr, ecn,
+                                            data, datalen, gso_size));
+  }
+#endif // HAVE_LIBBPF
+
+#ifdef HAVE_LIBDPDK
+  if (dpdk_.queue) {
+    return print_frame_sent(local_addr, remote_addr, ecn,
+                            dpdk_.queue->send(local_addr, remote_addr, ecn,
+                                              data, datalen, gso_size));
+  }
+#endif // HAVE_LIBDPDK
+
+  if (no_gso && datalen > gso_size) {
+    size_t nsent = 0;
+
+    for (auto p = data; p < data + datalen; p += gso_size) {
+      auto len = std::min(gso_size, static_cast<size_t>(data + datalen - p));
+
+      auto [n, rv] = send_packet_now(ep, no_gso, local_addr, remote_addr,
+                                     ecn, p, len, len, txtime);
+      if (rv != 0) {
+        return {nsent, rv};
+      }
+
+      nsent += n;
+    }
+
+    return {nsent, 0};
+  }
+
+  iovec msg_iov;
+  msg_iov.iov_base = const_cast<uint8_t *>(data);
+  msg_iov.iov_len = datalen;
+
+  msghdr msg{};
+  msg.msg_name = const_cast<sockaddr *>(remote_addr.addr);
+  msg.msg_namelen = remote_addr.addrlen;
+  msg.msg_iov = &msg_iov;
+  msg.msg_iovlen = 1;
+
+  std::array<uint8_t, tx_msg_ctrllen> msg_ctrl;
+
+  msghdr_set_txinfo(&msg, msg_ctrl.data(), local_addr, datalen, gso_size,
+                    txtime);
+
+  if (ep.ecn != ecn) {
+    ep.ecn = ecn;
+    fd_set_ecn(ep.fd, ep.addr.su.storage.ss_family, ecn);
+  }
+
+  ssize_t nwrite = 0;
+
+  do {
+    nwrite = sendmsg(ep.fd, &msg, 0);
+  } while (nwrite == -1 && errno == EINTR);
+
+  if (nwrite == -1) {
+    switch (errno) {
+    case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+    case EWOULDBLOCK:
+#endif // EAGAIN != EWOULDBLOCK
+      return {0, NETWORK_ERR_SEND_BLOCKED};
+#ifdef UDP_SEGMENT
+    case EIO:
+      if (datalen > gso_size) {
+        // GSO failure; send each packet in a separate sendmsg call.
+        std::cerr << "sendmsg: disabling GSO due to " << strerror(errno)
+                  << std::endl;
+
+        no_gso = true;
+
+        return send_packet_now(ep, no_gso, local_addr, remote_addr, ecn,
+                               data, datalen, gso_size, txtime);
+      }
+      break;
+#endif // UDP_SEGMENT
+    }
+
+    std::cerr << "sendmsg: " << strerror(errno) << std::endl;
+    // TODO We have packet which is expected to fail to send (e.g.,
+    // path validation to old path).
+    return {0, NETWORK_ERR_OK};
+  }
+
+  if (!config.quiet) {
+    std::cerr << "Sent packet: local="
+              << util::straddr(local_addr.addr, local_addr.addrlen)
+              << " remote="
+              << util::straddr(remote_addr.addr, remote_addr.addrlen)
+              << " ecn=0x" << std::hex << ecn << std::dec << " " << nwrite
+              << " bytes" << std::endl;
+  }
+
+  return {nwrite, NETWORK_ERR_OK};
+}
+
+void Server::netem_send(Endpoint &ep, const ngtcp2_addr &local_addr,
+                        const ngtcp2_addr &remote_addr, unsigned int ecn,
+                        const uint8_t *data, size_t datalen,
+                        size_t gso_size) {
+  assert(gso_size);
+
+  auto ts = util::timestamp(loop_);
+
+  for (auto p = data; p < data + datalen; p += gso_size) {
+    auto len = std::min(gso_size, static_cast<size_t>(data + datalen - p));
+
+    netem_.link->send(&ep, local_addr, remote_addr, ecn, p, len, ts);
+  }
+
+  update_netem_timer();
+}
+
+void Server::update_netem_timer() {
+  auto expiry = netem_.link->expiry();
+  if (expiry == UINT64_MAX) {
+    ev_timer_stop(loop_, &netem_.timer);
+    return;
+  }
+
+  auto now = util::timestamp(loop_);
+
+  // ev_timer_again stops the timer if repeat is 0.
+  netem_.timer.repeat =
+      expiry > now ? static_cast<ev_tstamp>(expiry - now) / NGTCP2_SECONDS
+                   : 1e-9;
+  ev_timer_again(loop_, &netem_.timer);
+}
+
+void Server::on_netem() {
+  netem_.link->deliver(util::timestamp(loop_), [this](NetEmPacket &pkt) {
+    auto ep = static_cast<Endpoint *>(pkt.user_data);
+    ngtcp2_addr local_addr{
+        .addr = &pkt.local_addr.su.sa,
+        .addrlen = pkt.local_addr.len,
+    };
+    ngtcp2_addr remote_addr{
+        .addr = &pkt.remote_addr.su.sa,
+        .addrlen = pkt.remote_addr.len,
+    };
+    auto no_gso = false;
+
+    // The packet which the socket cannot take is dropped as the
+    // router would do.
+    send_packet_now(*ep, no_gso, local_addr, remote_addr, pkt.ecn,
+                    pkt.data.data(), pkt.data.size(), pkt.data.size(),
+                    /* txtime = */ 0);
+  });
+
+  update_netem_timer();
+}
+
+void Server::queue_packet(Handler *h, bool &no_gso, Endpoint &ep,
+                          const ngtcp2_addr &local_addr,
+                          const ngtcp2_addr &remote_addr, unsigned int ecn,
+                          const uint8_t *data, size_t datalen,
+                          size_t gso_size, uint64_t txtime) {
+  assert(gso_size);
+
+  if (netem_.link) {
+    netem_send(ep, local_addr, remote_addr, ecn, data, datalen, gso_size);
+    return;
+  }
+
+  if (debug::packet_lost(config.tx_loss_prob)) {
+    if (!config.quiet) {
+      std::cerr << "** Simulated outgoing packet loss **" << std::endl;
+    }
+    return;
+  }
+
+  if (tx_.entries.size() == config.send_batch) {
+    flush_tx();
+  }
+
+  auto &e = tx_.entries.emplace_back();
+
+  e.handler = h;
+  e.endpoint = &ep;
+  memcpy(&e.local_addr.su, local_addr.addr, local_addr.addrlen);
+  e.local_addr.len = local_addr.addrlen;
+  memcpy(&e.remote_addr.su, remote_addr.addr, remote_addr.addrlen);
+  e.remote_addr.len = remote_addr.addrlen;
+  e.ecn = ecn;
+  e.data = data;
+  e.datalen = datalen;
+  e.gso_size = gso_size;
+  e.txtime = txtime;
+  e.no_gso = &no_gso;
+
+  h->set_tx_queued(true);
+
+  ++tx_stats_.nentry;
+}
+
+void Server::flush_tx() {
+  auto &entries = tx_.entries;
+
+  for (size_t i = 0; i < entries.size();) {
+    auto j = i + 1;
+
+    for (; j < entries.size() && entries[j].endpoint == entries[i].endpoint &&
+           entries[j].ecn == entries[i].ecn;
+         ++j)
+      ;
+
+    send_tx_entries(i, j);
+
+    i = j;
+  }
+
+  for (auto &e : entries) {
+    e.handler->set_tx_queued(false);
+  }
+
+  entries.clear();
+}
+
+std::unique_ptr<uint8_t[]> Server::acquire_txbuf() {
+  if (tx_.bufs.empty()) {
+    ++tx_stats_.ntxbuf;
+
+    return std::unique_ptr<uint8_t[]>(new uint8_t[tx_bufsize]);
+  }
+
+  auto buf = std::move(tx_.bufs.back());
+  tx_.bufs.pop_back();
+
+  return buf;
+}
+
+void Server::release_txbuf(std::unique_ptr<uint8_t[]> buf) {
+  tx_.bufs.push_back(std::move(buf));
+}
+
+void Server::queue_proxy_tx(UDPProxy *proxy) {
+  if (proxy->tx.queued) {
+    return;
+  }
+
+  proxy->tx.queued = true;
+  proxy_txq_.push_back(proxy);
+}
+
+void Server::remove_proxy_tx(UDPProxy *proxy) {
+  // The datagrams are dropped along with the tunnel.
+  proxy_txq_.erase(
+      std::find(std::begin(proxy_txq_), std::end(proxy_txq_), proxy));
+  proxy->tx.queued = false;
+}
+
+void Server::flush_proxy_tx() {
+  for (auto proxy : proxy_txq_) {
+    proxy->flush_tx();
+    proxy->tx.queued = false;
+  }
+
+  proxy_txq_.clear();
+}
+
+#ifdef HAVE_SENDMMSG
+void Server::block_tx_entries(Endpoint &ep, size_t i, size_t offset,
+                              size_t last) {
+  for (; i < last; ++i, offset = 0) {
+    auto &e = tx_.entries[i];
+
+    ngtcp2_addr local_addr{
+        .addr = &e.local_addr.su.sa,
+        .addrlen = e.local_addr.len,
+    };
+    ngtcp2_addr remote_addr{
+        .addr = &e.remote_addr.su.sa,
+        .addrlen = e.remote_addr.len,
+    };
+
+    e.handler->on_send_blocked(ep, local_addr, remote_addr, e.ecn,
+                               e.data + offset, e.datalen - offset,
+                               e.gso_size, e.txtime);
+    e.handler->start_wev_endpoint(ep);
+  }
+}
+
+void Server::send_tx_entries(size_t first, size_t last) {
+  auto &ep = *tx_.entries[first].endpoint;
+  auto ecn = tx_.entries[first].ecn;
+
+  auto &msgent = tx_.msgent;
+  msgent.clear();
+
+  for (auto i = first; i < last; ++i) {
+    auto &e = tx_.entries[i];
+
+    // Keep the order of packets of a Handler which has been blocked
+    // by the preceding entry.
+    if (e.handler->send_blocked()) {
+      block_tx_entries(ep, i, 0, i + 1);
+      continue;
+    }
+
+    if (*e.no_gso && e.datalen > e.gso_size) {
+      for (size_t off = 0; off < e.datalen; off += e.gso_size) {
+        msgent.emplace_back(i, off);
+      }
+    } else {
+      msgent.emplace_back(i, 0);
+    }
+  }
+
+  auto nmsg = msgent.size();
+
+  if (nmsg == 0) {
+    return;
+  }
+
+  tx_.msgs.resize(nmsg);
+  tx_.iovs.resize(nmsg);
+  tx_.ctrl.resize(nmsg * tx_msg_ctrllen);
+
+  for (size_t k = 0; k < nmsg; ++k) {
+    auto &e = tx_.entries[msgent[k].first];
+    auto off = msgent[k].second;
+    auto len = *e.no_gso ? std::min(e.gso_size, e.datalen - off) : e.datalen;
+
+    tx_.iovs[k].iov_base = const_cast<uint8_t *>(e.data + off);
+    tx_.iovs[k].iov_len = len;
+
+    auto &msg = tx_.msgs[k].msg_hdr;
+    msg = {};
+    msg.msg_name = &e.remote_addr.su.sa;
+    msg.msg_namelen = e.remote_addr.len;
+    msg.msg_iov = &tx_.iovs[k];
+    msg.msg_iovlen = 1;
+
+    ngtcp2_addr local_addr{
+        .addr = &e.local_addr.su.sa,
+        .addrlen = e.local_addr.len,
+    };
+
+    msghdr_set_txinfo(&msg, tx_.ctrl.data() + k * tx_msg_ctrllen, local_addr,
+                      len, e.gso_size, e.txtime);
+  }
+
+  if (ep.ecn != ecn) {
+    ep.ecn = ecn;
+    fd_set_ecn(ep.fd, ep.addr.su.storage.ss_family, ecn);
+  }
+
+#ifdef HAVE_LIBURING
+  if (config.io_uring) {
+    uring_send_tx_msgs(ep, last);
+    return;
+  }
+#endif // HAVE_LIBURING
+
+  send_tx_msgs(ep, last, 0);
+}
+
+void Server::on_tx_msgs_sent(size_t k, size_t n) {
+  ++tx_stats_.ncall;
+  tx_stats_.nmsg += n;
+  tx_stats_.max_batch = std::max(tx_stats_.max_batch, n);
+
+  if (config.quiet) {
+    return;
+  }
+
+  for (auto end = k + n; k < end; ++k) {
+    auto &e = tx_.entries[tx_.msgent[k].first];
+
+    std::cerr << "Sent packet: local="
+              << util::straddr(&e.local_addr.su.sa, e.local_addr.len)
+              << " remote="
+              << util::straddr(&e.remote_addr.su.sa, e.remote_addr.len)
+              << " ecn=0x" << std::hex << e.ecn << std::dec << " "
+              << tx_.iovs[k].iov_len << " bytes" << std::endl;
+  }
+}
+
+void Server::send_tx_msgs(Endpoint &ep, size_t last, size_t k) {
+  auto &msgent = tx_.msgent;
+  auto nmsg = msgent.size();
+
+  while (k < nmsg) {
+    int nsent;
+
+    do {
+      nsent = sendmmsg(ep.fd, tx_.msgs.data() + k, nmsg - k, 0);
+    } while (nsent == -1 && errno == EINTR);
+
+    if (nsent == -1) {
+      auto i = msgent[k].first;
+      auto &e = tx_.entries[i];
+
+      switch (errno) {
+      case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+      case EWOULDBLOCK:
+#endif // EAGAIN != EWOULDBLOCK
+        block_tx_entries(ep, i, msgent[k].second, last);
+        return;
+#ifdef UDP_SEGMENT
+      case EIO:
+        if (!*e.no_gso && e.datalen > e.gso_size) {
+          // GSO failure; let send_packet disable GSO and send the
+          // remaining packets of this entry separately.
+          ngtcp2_addr local_addr{
+              .addr = &e.local_addr.su.sa,
+              .addrlen = e.local_addr.len,
+          };
+          ngtcp2_addr remote_addr{
+              .addr = &e.remote_addr.su.sa,
+              .addrlen = e.remote_addr.len,
+          };
+
+          auto [n, rv] =
+              send_packet(ep, *e.no_gso, local_addr, remote_addr, e.ecn,
+                          e.data, e.datalen, e.gso_size, e.txtime);
+          if (rv != NETWORK_ERR_OK) {
+            assert(NETWORK_ERR_SEND_BLOCKED == rv);
+
+            block_tx_entries(ep, i, n, last);
+
+            return;
+          }
+
+          ++k;
+
+          continue;
+        }
+        break;
+#endif // UDP_SEGMENT
+      }
+
+      std::cerr << "sendmmsg: " << strerror(errno) << std::endl;
+      // TODO We have packet which is expected to fail to send (e.g.,
+      // path validation to old path).
+      ++k;
+
+      continue;
+    }
+
+    on_tx_msgs_sent(k, nsent);
+
+    k += nsent;
+  }
+}
+
+#  ifdef HAVE_LIBURING
+void Server::uring_send_tx_msgs(Endpoint &ep, size_t last) {
+  auto nmsg = tx_.msgent.size();
+
+  // A linked chain must be submitted at once.
+  if (io_uring_sq_space_left(&uring_.ring) < nmsg) {
+    io_uring_submit(&uring_.ring);
+
+    if (io_uring_sq_space_left(&uring_.ring) < nmsg) {
+      send_tx_msgs(ep, last, 0);
+      return;
+    }
+  }
+
+  for (size_t k = 0; k < nmsg; ++k) {
+    auto sqe = io_uring_get_sqe(&uring_.ring);
+
+    io_uring_prep_sendmsg(sqe, ep.fd, &tx_.msgs[k].msg_hdr, 0);
+    io_uring_sqe_set_data64(sqe, uring_op_send << 32 | k);
+
+    // Chain the messages so that they are sent in order, and the
+    // messages after the failed one are canceled.
+    if (k + 1 < nmsg) {
+      sqe->flags |= IOSQE_IO_LINK;
+    }
+  }
+
+  if (auto rv = io_uring_submit(&uring_.ring); rv < 0) {
+    std::cerr << "io_uring_submit: " << strerror(-rv) << std::endl;
+    send_tx_msgs(ep, last, 0);
+    return;
+  }
+
+  auto &res = tx_.uring_res;
+  res.assign(nmsg, 0);
+
+  for (size_t ncomp = 0; ncomp < nmsg;) {
+    io_uring_cqe *cqe;
+
+    if (auto rv = io_uring_wait_cqe(&uring_.ring, &cqe); rv != 0) {
+      if (rv == -EINTR) {
+        continue;
+      }
+
+      std::cerr << "io_uring_wait_cqe: " << strerror(-rv) << std::endl;
+      return;
+    }
+
+    auto user_data = io_uring_cqe_get_data64(cqe);
+
+    if ((user_data >> 32) == uring_op_send) {
+      res[user_data & 0xffffffffu] = cqe->res;
+      ++ncomp;
+    } else {
+      // Receive completions are processed after the transmit queue is
+      // flushed.
+      uring_.cqes.push_back(UringCqe{
+          .user_data = user_data,
+          .res = cqe->res,
+          .flags = cqe->flags,
+      });
+    }
+
+    io_uring_cqe_seen(&uring_.ring, cqe);
+  }
+
+  if (!uring_.cqes.empty()) {
+    ev_feed_event(loop_, &uring_.rev, EV_READ);
+  }
+
+  size_t k = 0;
+  for (; k < nmsg && res[k] >= 0; ++k)
+    ;
+
+  if (k) {
+    on_tx_msgs_sent(0, k);
+  }
+
+  if (k == nmsg) {
+    return;
+  }
+
+  if (res[k] == -EAGAIN) {
+    block_tx_entries(ep, tx_.msgent[k].first, tx_.msgent[k].second, last);
+    return;
+  }
+
+  // Let sendmmsg path handle the other errors including GSO failure.
+  send_tx_msgs(ep, last, k);
+}
+#  endif // HAVE_LIBURING
+#else  // !defined(HAVE_SENDMMSG)
+void Server::send_tx_entries(size_t first, size_t last) {
+  // --send-batch > 1 is rejected if sendmmsg is not available.
+  assert(0);
+}
+#endif // !defined(HAVE_SENDMMSG)
+
+void Server::schedule_timer(TimerWheelEntry *e, ngtcp2_tstamp expiry) {
+  timers_.wheel.schedule(e, expiry);
+}
+
+void Server::cancel_timer(TimerWheelEntry *e) { timers_.wheel.cancel(e); }
+
+void Server::update_wheel_timer() {
+  auto expiry = timers_.wheel.next_expiry();
+  if (expiry == timers_.armed) {
+    return;
+  }
+
+  timers_.armed = expiry;
+
+  if (expiry == UINT64_MAX) {
+    ev_timer_stop(loop_, &timers_.timer);
+    return;
+  }
+
+  auto now = util::timestamp(loop_);
+
+  // ev_timer_again stops the timer if repeat is 0.
+  timers_.timer.repeat =
+      expiry > now ? static_cast<ev_tstamp>(expiry - now) / NGTCP2_SECONDS
+                   : 1e-9;
+  ev_timer_again(loop_, &timers_.timer);
+}
+
+void Server::on_timer_wheel() {
+  ev_timer_stop(loop_, &timers_.timer);
+  timers_.armed = UINT64_MAX;
+
+  timers_.wheel.expire(util::timestamp(loop_), [](TimerWheelEntry *e) {
+    handle_timeout(static_cast<Handler *>(e->data));
+  });
+
+  update_wheel_timer();
+}
+
+void Server::add_half_open() { ++admission_.half_open; }
+
+void Server::add_bdp(int64_t delta) {
+  sock_buf_.bdp = static_cast<uint64_t>(static_cast<int64_t>(sock_buf_.bdp) +
+                                        delta);
+}
+
+void Server::update_sock_buf() {
+  // Leave room for the bursts from the connections which arrive at
+  // once.
+  auto target =
+      std::clamp(sock_buf_.bdp * 2, sock_buf_.min, config.sock_buf_max);
+
+  // Grow promptly, but shrink only if the buffers are more than twice
+  // as large as needed so that the size does not flap.
+  if (target == sock_buf_.size ||
+      (target < sock_buf_.size && target * 2 > sock_buf_.size)) {
+    return;
+  }
+
+  for (auto &ep : endpoints_) {
+    if (fd_set_sock_bufsize(ep.fd, static_cast<int>(target)) != 0) {
+      return;
+    }
+  }
+
+  if (!config.quiet) {
+    std::cerr << "Socket buffer size " << sock_buf_.size << " -> " << target
+              << " bytes" << std::endl;
+  }
+
+  metrics_->sock_buf_bytes.add(static_cast<int64_t>(target) -
+                               static_cast<int64_t>(sock_buf_.size));
+  sock_buf_.size = target;
+}
+
+void Server::remove_half_open() {
+  assert(admission_.half_open);
+
+  --admission_.half_open;
+}
+
+namespace {
+// hash_addr_prefix returns the hash of the address prefix of |sa|,
+// which is /24 for IPv4, and /48 for IPv6.
+uint32_t hash_addr_prefix(const sockaddr *sa, uint32_t seed) {
+  const uint8_t *p;
+  size_t len;
+
+  switch (sa->sa_family) {
+  case AF_INET:
+    p = reinterpret_cast<const uint8_t *>(
+        &reinterpret_cast<const sockaddr_in *>(sa)->sin_addr);
+    len = 3;
+    break;
+  case AF_INET6:
+    p = reinterpret_cast<const uint8_t *>(
+        &reinterpret_cast<const sockaddr_in6 *>(sa)->sin6_addr);
+    len = 6;
+    break;
+  default:
+    return seed;
+  }
+
+  uint32_t h = 0x811C9DC5u ^ seed;
+  for (auto end = p + len; p != end; ++p) {
+    h ^= *p;
+    h *= 0x01000193u;
+  }
+
+  return h;
+}
+} // namespace
+
+bool Server::need_retry(const sockaddr *sa) {
+  if (config.retry_half_open &&
+      admission_.half_open >= config.retry_half_open) {
+    return true;
+  }
+
+  if (!config.initial_rate) {
+    return false;
+  }
+
+  auto &b = admission_.buckets[hash_addr_prefix(sa, admission_.seed) %
+                               admission_.buckets.size()];
+  auto now = util::timestamp(loop_);
+  auto rate = config.initial_rate;
+
+  if (now - b.last_ts >= NGTCP2_SECONDS) {
+    b.tokens = rate;
+    b.last_ts = now;
+  } else if (auto n = (now - b.last_ts) * rate / NGTCP2_SECONDS; n) {
+    b.tokens = std::min(rate, b.tokens + static_cast<size_t>(n));
+    b.last_ts += n * NGTCP2_SECONDS / rate;
+  }
+
+  if (b.tokens == 0) {
+    return true;
+  }
+
+  --b.tokens;
+
+  return false;
+}
+
+void Server::associate_cid(const ngtcp2_cid *cid, Handler *h) {
+  handlers_.emplace(cid, h);
+}
+
+void Server::dissociate_cid(const ngtcp2_cid *cid) {
+  handlers_.erase(cid);
+}
+
+static_assert(NGTCP2_STATELESS_RESET_TOKENLEN <= NGTCP2_MAX_CIDLEN);
+
+void Server::associate_reset_token(const uint8_t *token, Handler *h) {
+  reset_tokens_.emplace(token, NGTCP2_STATELESS_RESET_TOKENLEN, h);
+}
+
+void Server::dissociate_reset_token(const uint8_t *token, const Handler *h) {
+  if (auto ph = reset_tokens_.find(token, NGTCP2_STATELESS_RESET_TOKENLEN);
+      ph && *ph == h) {
+    reset_tokens_.erase(token, NGTCP2_STATELESS_RESET_TOKENLEN);
+  }
+}
+
+Handler **Server::find_reset_token(const uint8_t *data, size_t datalen) {
+  if (reset_tokens_.empty() ||
+      datalen < 1 + NGTCP2_MIN_STATELESS_RESET_RANDLEN +
+                    NGTCP2_STATELESS_RESET_TOKENLEN) {
+    return nullptr;
+  }
+
+  return reset_tokens_.find(data + datalen - NGTCP2_STATELESS_RESET_TOKENLEN,
+                            NGTCP2_STATELESS_RESET_TOKENLEN);
+}
+
+ngtcp2_crypto_token_ctx *Server::token_ctx() { return &token_ctx_; }
+
+int Server::generate_cid(uint8_t *data, size_t datalen) {
+  assert(datalen);
+
+  if (!config.quic_lb_server_id.empty()) {
+    assert(datalen == 1 + lb_config_.server_idlen + lb_config_.noncelen);
+
+    std::array<uint8_t, NGTCP2_MAX_CIDLEN> nonce;
+    ngtcp2_cid cid;
+
+    if (util::generate_secure_random(nonce.data(), lb_config_.noncelen) != 0 ||
+        ngtcp2_crypto_quic_lb_generate_cid(&cid, &lb_config_, nonce.data()) !=
+            0) {
+      return -1;
+    }
+
+    std::copy_n(cid.data, cid.datalen, data);
+
+    return 0;
+  }
+
+  if (util::generate_secure_random(data, datalen) != 0) {
+    return -1;
+  }
+
+  if (config.workers > 1) {
+    // Keep the first byte random, but make it congruent to worker_id_
+    // modulo the number of workers.  The eBPF program maps it back
+    // to the worker with the same operation.
+    auto nbucket = 256 / config.workers;
+    data[0] = static_cast<uint8_t>((data[0] % nbucket) * config.workers +
+                                   worker_id_);
+  }
+
+  return 0;
+}
+
+const RecvStats &Server::recv_stats() const { return rx_stats_; }
+
+const SendStats &Server::send_stats() const { return tx_stats_; }
+
+FileStats &Server::file_stats() { return file_stats_; }
+
+const std::string &Server::http_date() {
+  return date_cache_.get(static_cast<time_t>(ev_now(loop_)));
+}
+
+EarlyDataStats &Server::early_data_stats() { return early_data_stats_; }
+
+WorkerMetrics &Server::metrics() { return *metrics_; }
+
+ngtcp2_transport_params_template &Server::transport_params_template() {
+  return tp_template_;
+}
+
+const std::vector<Endpoint> &Server::endpoints() const { return endpoints_; }
+
+const Address &Server::preferred_ipv4_addr() const {
+  return preferred_ipv4_addr_;
+}
+
+const Address &Server::preferred_ipv6_addr() const {
+  return preferred_ipv6_addr_;
+}
+
+void Server::remove(const Handler *h) {
+  auto conn = h->conn();
+
+  handlers_.erase(ngtcp2_conn_get_client_initial_dcid(conn));
+
+  std::vector<ngtcp2_cid> cids(ngtcp2_conn_get_num_scid(conn));
+  ngtcp2_conn_get_scid(conn, cids.data());
 
   for (auto &cid : cids) {
-    handlers_.erase(util::make_cid_key(&cid));
+    handlers_.erase(&cid);
   }
 
   delete h;
 }
 
+void Server::add_tombstone(Handler *h) {
+  auto conn = h->conn();
+  auto &t = tombstones_.entries.emplace_back();
+
+  t.cids.resize(ngtcp2_conn_get_num_scid(conn));
+  ngtcp2_conn_get_scid(conn, t.cids.data());
+  t.cids.push_back(*ngtcp2_conn_get_client_initial_dcid(conn));
+
+  if (!ngtcp2_conn_is_in_draining_period(conn)) {
+    if (auto closebuf = h->conn_closebuf(); closebuf) {
+      t.closebuf.assign(closebuf->rpos(), closebuf->rpos() + closebuf->size());
+    }
+  }
+
+  auto path = ngtcp2_conn_get_path(conn);
+
+  t.ep = static_cast<Endpoint *>(path->user_data);
+  t.local_addr.len = path->local.addrlen;
+  memcpy(&t.local_addr.su, path->local.addr, path->local.addrlen);
+  t.local_addr.ifindex = 0;
+  t.remote_addr.len = path->remote.addrlen;
+  memcpy(&t.remote_addr.su, path->remote.addr, path->remote.addrlen);
+  t.remote_addr.ifindex = 0;
+
+  auto now = util::timestamp(loop_);
+
+  t.expiry = now + 3 * ngtcp2_conn_get_pto(conn);
+
+  remove(h);
+
+  for (auto &cid : t.cids) {
+    tombstones_.cids.emplace(&cid, &t);
+  }
+
+  if (tombstones_.entries.size() == 1) {
+    tombstones_.timer.repeat =
+        static_cast<ev_tstamp>(t.expiry - now) / NGTCP2_SECONDS;
+    ev_timer_again(loop_, &tombstones_.timer);
+  }
+}
+
+void Server::expire_tombstones() {
+  auto now = util::timestamp(loop_);
+  auto &entries = tombstones_.entries;
+
+  for (; !entries.empty() && entries.front().expiry <= now;
+       entries.pop_front()) {
+    auto &t = entries.front();
+
+    if (!config.quiet) {
+      if (t.closebuf.empty()) {
+        std::cerr << "Draining Period is over" << std::endl;
+      } else {
+        std::cerr << "Closing Period is over" << std::endl;
+      }
+    }
+
+    for (auto &cid : t.cids) {
+      tombstones_.cids.erase(&cid);
+    }
+  }
+
+  if (entries.empty()) {
+    ev_timer_stop(loop_, &tombstones_.timer);
+    return;
+  }
+
+  // ev_timer_again stops the timer if repeat is 0.
+  tombstones_.timer.repeat =
+      std::max(static_cast<ev_tstamp>(entries.front().expiry - now) /
+                   NGTCP2_SECONDS,
+               1e-9);
+  ev_timer_again(loop_, &tombstones_.timer);
+}
+
+void Server::schedule_keep_alive(Handler *h) {
+  auto expiry = ngtcp2_conn_get_keep_alive_expiry(h->conn());
+  if (expiry == UINT64_MAX) {
+    keep_alive_.wheel.cancel(h->keep_alive_entry());
+    return;
+  }
+
+  // Round down, so that the connection is pinged before its
+  // keep-alive timer expires.
+  keep_alive_.wheel.schedule(h->keep_alive_entry(),
+                             expiry / keep_alive_.window * keep_alive_.window);
+}
+
+void Server::cancel_keep_alive(Handler *h) {
+  keep_alive_.wheel.cancel(h->keep_alive_entry());
+}
+
+void Server::update_keep_alive_timer() {
+  auto expiry = keep_alive_.wheel.next_expiry();
+  if (expiry == keep_alive_.armed) {
+    return;
+  }
+
+  keep_alive_.armed = expiry;
+
+  if (expiry == UINT64_MAX) {
+    ev_timer_stop(loop_, &keep_alive_.timer);
+    return;
+  }
+
+  auto now = util::timestamp(loop_);
+
+  // ev_timer_again stops the timer if repeat is 0.
+  keep_alive_.timer.repeat =
+      expiry > now ? static_cast<ev_tstamp>(expiry - now) / NGTCP2_SECONDS
+                   : 1e-9;
+  ev_timer_again(loop_, &keep_alive_.timer);
+}
+
+void Server::on_keep_alive() {
+  ev_timer_stop(loop_, &keep_alive_.timer);
+  keep_alive_.armed = UINT64_MAX;
+
+  auto now = util::timestamp(loop_);
+  size_t npings = 0;
+
+  keep_alive_.wheel.expire(now, [this, now, &npings](TimerWheelEntry *e) {
+    auto h = static_cast<Handler *>(e->data);
+
+    // The connection which has sent or received a packet since it was
+    // scheduled is not pinged yet.
+    if (ngtcp2_conn_get_keep_alive_expiry(h->conn()) <=
+        now + keep_alive_.window) {
+      if (auto rv = h->send_keep_alive(); rv != 0) {
+        if (rv == NETWORK_ERR_CLOSE_WAIT) {
+          add_tombstone(h);
+        } else {
+          remove(h);
+        }
+
+        return;
+      }
+
+      ++npings;
+    }
+
+    schedule_keep_alive(h);
+  });
+
+  if (!config.quiet && npings) {
+    std::cerr << "Keep-alive: pinged " << npings << " connection(s)"
+              << std::endl;
+  }
+
+  update_keep_alive_timer();
+}
+
 namespace {
 int parse_host_port(Address &dest, int af, const char *first,
                     const char *last) {
@@ -3125,10 +6268,33 @@ void config_set_default(Config &config) {
   config.max_streams_uni = 3;
   config.max_dyn_length = 20_m;
   config.cc_algo = NGTCP2_CC_ALGO_CUBIC;
+  config.pto_probe_policy = NGTCP2_PTO_PROBE_POLICY_NEW_DATA_FIRST;
   config.initial_rtt = NGTCP2_DEFAULT_INITIAL_RTT;
   config.max_gso_dgrams = 10;
   config.handshake_timeout = NGTCP2_DEFAULT_HANDSHAKE_TIMEOUT;
   config.ack_thresh = 2;
+  config.retry_half_open = 1024;
+  config.recv_batch = 1;
+  config.send_batch = 1;
+  config.workers = 1;
+  config.file_cache_size = 256_m;
+  config.unsafe_early_request = EarlyRequestPolicy::DEFER;
+}
+} // namespace
+
+namespace {
+std::string_view strearlyrequestpolicy(EarlyRequestPolicy policy) {
+  switch (policy) {
+  case EarlyRequestPolicy::ACCEPT:
+    return "accept";
+  case EarlyRequestPolicy::DEFER:
+    return "defer";
+  case EarlyRequestPolicy::REJECT:
+    return "reject";
+  default:
+    assert(0);
+    abort();
+  }
 }
 } // namespace
 
@@ -3154,6 +6320,26 @@ Options:
               The probability of losing incoming packets.  <P> must be
               [0.0, 1.0],  inclusive.  0.0 means no  packet loss.  1.0
               means 100% packet loss.
+  --netem=<SPEC>
+              Send packets through a link emulated in the process.  It
+              needs no root privileges.  <SPEC> is a comma separated
+              list of <KEY>=<VALUE>:
+                delay=<DURATION>  one-way delay
+                jitter=<DURATION> maximum deviation from the delay
+                rate=<SIZE>       bandwidth in bytes per second
+                limit=<SIZE>      bytes waiting for the link before
+                                  the tail is dropped
+                loss=<P>          random loss
+                ge=<P>/<R>[/<LB>[/<LG>]]
+                                  Gilbert-Elliott loss.  <P> and <R>
+                                  are the probabilities of entering
+                                  and leaving the bad state.  <LB>
+                                  (default: 1.0) and <LG> (default:
+                                  0.0) are the loss in the bad and
+                                  the good state.
+                reorder=<P>       probability of skipping the delay
+                seed=<N>          seed of random number generator
+              Example: "delay=25ms,jitter=2ms,rate=1250K,limit=64K"
   --ciphers=<CIPHERS>
               Specify the cipher suite list to enable.
               Default: )"
@@ -3174,12 +6360,32 @@ Options:
             << util::format_duration(config.timeout) << R"(
   -V, --validate-addr
               Perform address validation.
+  --retry-half-open=<N>
+              Send Retry to a new client which has not validated its
+              address while there  are <N> or more half-open connections.
+              0 disables this check.
+              Default: )"
+            << config.retry_half_open << R"(
+  --initial-rate=<N>
+              Accept up to <N> new connections per second from an address
+              prefix (/24 for IPv4, /48 for IPv6) without address
+              validation, and send Retry to the rest.  0 disables this
+              check.
+              Default: )"
+            << config.initial_rate << R"(
   --preferred-ipv4-addr=<ADDR>:<PORT>
               Specify preferred IPv4 address and port.
   --preferred-ipv6-addr=<ADDR>:<PORT>
               Specify preferred IPv6 address and port.  A numeric IPv6
               address  must   be  enclosed  by  '['   and  ']'  (e.g.,
               [::1]:8443)
+  --preferred-addr-per-worker
+              Each worker advertises its own preferred address whose port
+              is  the  port  of  --preferred-ipv4-addr  or
+              --preferred-ipv6-addr  plus  the  worker  ID  (starting  at
+              0),  and  listens  on  it  without  SO_REUSEPORT.   Clients
+              which  migrate  from  the  shared  (e.g.,  anycast) address
+              reach the worker that owns the connection directly.
   --mime-types-file=<PATH>
               Path  to file  that contains  MIME media  types and  the
               extensions.
@@ -3197,6 +6403,27 @@ Options:
               Path to  the directory where  qlog file is  stored.  The
               file name  of each qlog  is the Source Connection  ID of
               server.
+  --qlog-compress
+              Compress qlog files with gzip.  ".gz" is appended to the
+              file name.  The server must be built with zlib.
+  --qlog-binary
+              Write qlog in the compact binary format instead of JSON.
+              The file extension becomes  ".bqlog".  Convert it to JSON
+              with qlogconv.
+  --qlog-ring=<SIZE>
+              Instead of writing a file for each connection, write qlog
+              into a  memory-mapped ring file  of <SIZE> bytes  for each
+              worker  under  --qlog-dir.   The  oldest  records  are
+              overwritten, so that  the rings keep the  latest qlog of
+              all connections.   Dump them  with qlogring.   This option
+              and --qlog-compress are mutually exclusive.
+  --trace-dir=<PATH>
+              Path to the directory where the packet trace of each
+              connection is stored.   The file name is the Source
+              Connection ID of server  followed by ".pkttrace".  The
+              recording  starts  once  the handshake  has  completed
+              and nothing is in flight.  The trace contains the 1RTT
+              secrets.  Replay it with bench_replay.
   --no-quic-dump
               Disables printing QUIC STREAM and CRYPTO frame data out.
   --no-http-dump
@@ -3232,7 +6459,7 @@ Options:
               The maximum length of a dynamically generated content.
               Default: )"
             << util::format_uint_iec(config.max_dyn_length) << R"(
-  --cc=(cubic|reno|bbr|bbr2)
+  --cc=(cubic|reno|bbr|bbr2|prague)
               The name of congestion controller algorithm.
               Default: )"
             << util::strccalgo(config.cc_algo) << R"(
@@ -3282,26 +6509,806 @@ Options:
               indicates  QUIC  v1,  and "v2draft"  indicates  QUIC  v2
               draft.
   --no-pmtud  Disables Path MTU Discovery.
+  --spin-bit  Enables the  latency spin bit, so that  on-path observers
+              can measure RTT passively.  It is still disabled for 1 in
+              16 connections at random.
+  --pto-probe-policy=<POLICY>
+              Specify what a PTO probe packet carries.  <POLICY> is one
+              of  "new-data-first",  which  sends  new  data  first,
+              "retransmit-oldest",  which  retransmits  the  oldest
+              in-flight packet  first, and  "duplicate-latest", which
+              retransmits the latest in-flight packet first.
+              Default: new-data-first
+  --pmtud-search
+              Find the path MTU by  binary search up to the size given
+              by --max-udp-payload-size, trying  the MTUs of Ethernet
+              and jumbo frames first.  With this option,
+              --max-udp-payload-size does not  disable the shaping of
+              UDP payload size to the discovered path MTU.
+  --fast-nat-rebinding
+              When only the port  number of client changes, keep sending
+              at  the  full  rate  without  the  anti-amplification limit
+              while the new path is validated in the background.
+  --quic-lb-server-id=<HEX>
+              Encode the server ID <HEX>  in every Connection ID in the
+              QUIC-LB format, so that a load balancer can route packets
+              to this server without keeping  per connection state.  It
+              must not  exceed )"
+            << NGTCP2_SV_SCIDLEN - 1 - NGTCP2_CRYPTO_QUIC_LB_MIN_NONCELEN
+            << R"( bytes.   It cannot be used with multiple
+              workers because it takes over the first byte of Connection
+              ID.
+  --quic-lb-config-id=<N>
+              QUIC-LB config rotation ID which is encoded in the first
+              byte of Connection ID.  It must not exceed )"
+            << NGTCP2_CRYPTO_QUIC_LB_MAX_CONFIG_ID << R"(.
+              Default: )"
+            << static_cast<int>(config.quic_lb_config_id) << R"(
+  --quic-lb-key=<SECRET>
+              The secret shared with the load balancers.  If it is given,
+              the server ID  and  the nonce in Connection ID are encrypted
+              with the key derived from it.  Otherwise, they are sent in
+              plaintext.
   --ack-thresh=<N>
               Override   ACK  threshold,   aka,   maximum  number   of
               unacknowledged   packets    before   sending    an   ACK
               immediately.
+  --recv-batch=<N>
+              Maximum number of UDP datagrams  that are received in a
+              single recvmmsg call.  If 1  is given, recvmsg is used.
+              The counters  of receive  path are  printed out  when
+              server exits.
+              Default: )"
+            << config.recv_batch << R"(
+  --gro       Enable UDP_GRO  so that  the kernel  coalesces incoming
+              datagrams.   Each  segment is  processed  as a  separate
+              packet.
+  --send-batch=<N>
+              Maximum number of GSO batches  from all connections that
+              are sent in a single sendmmsg call.  The batches queued
+              during an event loop iteration are flushed before  the
+              loop blocks.   If 1  is given, each  batch is  sent  by
+              sendmsg immediately.
+              Default: )"
+            << config.send_batch << R"(
+  --txtime=<DURATION>
+              Enable SO_TXTIME and attach the earliest departure time
+              computed by the pacer of ngtcp2 to each GSO batch so that
+              fq qdisc paces  packets  in  the  kernel.  <DURATION> is
+              the pacing horizon: packets are written up to this
+              duration ahead of their send time.
+  --timer-wheel
+              Manage the timers of all connections with a hierarchical
+              timer wheel driven by a single ev_timer instead of an
+              ev_timer per connection.
+  --keep-alive=<DURATION>
+              Send  PING  to a  connection  which  has  been  idle for
+              <DURATION>.   The  connections whose  keep-alive expires
+              in the same window are pinged in a batch by  a  single
+              timer  per  worker.   The  window is a granularity of a
+              timer wheel level which does not exceed 1/8 of
+              <DURATION>.
+  --io-uring  Receive  datagrams  with  multishot  recvmsg  of  io_uring
+              into a provided buffer ring.  The payload is passed to
+              the connection  without copying.  If  --send-batch  is
+              greater than  1, the  transmit queue  is submitted as a
+              linked chain  of sendmsg.   The server  must  be  built
+              with liburing.
+  --workers=<N>
+              The  number  of  worker  threads.   Each worker  has its
+              own event loop and  UDP sockets bound with SO_REUSEPORT.
+              Default: )"
+            << config.workers << R"(
+  --worker-cpus=<LIST>
+              Pin worker <i> to the <i>-th CPU  in <LIST>, e.g., "0-3"
+              or "0,2,4,6".  The sockets of the worker set
+              SO_INCOMING_CPU to that CPU, so that the kernel (6.2 or
+              later)  picks them  for  the packets  processed on it
+              unless --bpf-program is given.  Combined with the IRQ
+              affinity of the NIC which maps RSS queue <i> to the same
+              CPU, a packet  is processed  on the  core  which  took
+              the  interrupt.   Each  worker  is created on its CPU,
+              so that  its memory is allocated from the local NUMA
+              node.  <LIST> must have at least as many CPUs as
+              --workers.
+  --busy-poll=<DURATION>
+              Set  SO_BUSY_POLL  to the sockets so that a read busy
+              polls the device queue for up to <DURATION>  instead of
+              waiting for  the interrupt.   Raising it above
+              net.core.busy_read requires CAP_NET_ADMIN.
+  --sock-buf-max=<SIZE>
+              Resize SO_RCVBUF and SO_SNDBUF of the sockets every
+              second to twice the sum of the congestion windows of the
+              connections, but not larger than <SIZE>, so that a burst
+              is not dropped by the kernel.  The buffers never shrink
+              below the size initially given by the kernel.  The kernel
+              caps  the  size  to  net.core.rmem_max and
+              net.core.wmem_max.  The datagrams dropped by the kernel
+              are counted  separately from the packets lost in the
+              network regardless of this option.
+  --bpf-program=<PATH>
+              Path to  the eBPF  object file  which steers  incoming
+              packets  to the  worker  that  issued  the  Connection
+              ID.   If  it  is  not given,  or  the  server  is built
+              without libbpf,  the kernel  distributes packets  by  its
+              4-tuple hash.
+  --xdp=<IFNAME>
+              Receive  and send  QUIC  packets  on  <IFNAME>  through
+              AF_XDP  sockets,  bypassing the  kernel network stack.
+              Worker <i> binds its socket  to the receive queue given
+              by --xdp-queue plus  <i>.  Received payloads are passed
+              to  the  connection  without copying.   The  server must
+              be built with libbpf.  --xdp-program is required.  This
+              option cannot be used with --io-uring, or --send-batch
+              greater than 1.
+  --xdp-program=<PATH>
+              Path to the XDP object file which redirects UDP packets
+              destined to the server port to the AF_XDP sockets, and
+              passes everything else to the kernel.
+  --xdp-queue=<N>
+              The receive queue of <IFNAME> which the first worker binds
+              its AF_XDP socket to.
+              Default: )"
+            << config.xdp_queue << R"(
+  --dpdk=<PORT_ID>
+              Receive and send QUIC packets on DPDK port <PORT_ID> with
+              poll mode driver.  The port  has a receive and transmit
+              queue  pair  for each  worker, and  the  hardware spreads
+              incoming packets over them by RSS.  A packet is then
+              handed over to the worker which issued its Connection
+              ID.  Worker <i> runs on the <i>-th lcore given to EAL by
+              --dpdk-eal, and  polls its queue without blocking.  The
+              port has no ARP or Neighbor Discovery responder; the
+              peers  need a static neighbor entry  for  the  server
+              address.  The server must be built with libdpdk.  This
+              option cannot be used with --xdp, --io-uring, or
+              --send-batch greater than 1.
+  --dpdk-eal=<ARGS>
+              Whitespace separated arguments passed to DPDK EAL, e.g.,
+              "-l 2-5 -a 0000:3b:00.0".
+  --anti-replay
+              Reject  a replayed  0-RTT ClientHello.   The  ClientHellos
+              seen in  the last 20 seconds are  remembered in a filter
+              which  all workers  share.   A  replayed  ClientHello is
+              handshaken without  early data.  Only OpenSSL, BoringSSL
+              and GnuTLS support this option.
+  --file-extent=<SIZE>
+              Hand  a served  file to  HTTP/3  stack  in  extents  of
+              <SIZE> bytes.  Files are mapped with MADV_SEQUENTIAL and
+              the next extent is prefetched while the current one is
+              sent.  The counters of file serving, including the page
+              faults, are printed out when server exits.  If 0 is
+              given, the whole file is handed out at once.
+              Default: )"
+            << util::format_uint_iec(config.file_extent) << R"(
+  --file-cache-size=<SIZE>
+              The maximum total length of served files which are kept
+              mapped along with their response header fields.  The
+              cache is shared by all workers, and the least recently
+              used files are evicted first.  A file larger than <SIZE>
+              is mapped for each request.
+              Default: )"
+            << util::format_uint_iec(config.file_cache_size) << R"(
+  --dyn-pattern
+              Take the body of a dynamic response from a precomputed
+              pseudo random  pattern instead of a  shared zero-filled
+              buffer.   Each stream  starts  at  a different  offset,
+              and the checksum of  the body is sent in x-ngtcp2-checksum
+              trailer field, so that a client can detect corruption.
+  --unsafe-early-request=(accept|defer|reject)
+              Specify how to handle a  request which is received in
+              0-RTT, and whose method is not  safe (i.e., other than
+              GET, HEAD, OPTIONS, and TRACE).  0-RTT can be replayed
+              by an attacker.  "accept"  processes it immediately.
+              "defer" holds  it until the  handshake completes.
+              "reject" answers it with  425 (Too Early).  A request
+              with a safe method is always processed immediately.
+              The counters of the requests received in 0-RTT are
+              printed out when server exits.
+              Default: )"
+            << strearlyrequestpolicy(config.unsafe_early_request)
+            << R"(
+  --metrics-addr=<ADDR>:<PORT>
+              Serve  the metrics  of all  workers in  Prometheus text
+              format over  HTTP/1.1 on  TCP <ADDR>:<PORT>.   They are
+              the numbers of  packets and bytes sent  and received, GSO
+              batch  sizes,  handshakes and  their  latency, and,  for
+              the  closed connections,  lost packets,  decryption
+              failures, congestion window, and the time during which
+              they could not send packets.
+  --event-loop=<BACKEND>
+              The backend of  the event loops: auto, select, poll,
+              epoll, kqueue, port, linuxaio, or io_uring.  It must be
+              supported by  libev and the kernel.   auto lets libev
+              choose.
+              Default: auto
+  --event-loop-busy-poll
+              Poll the backend of the event loops  without blocking
+              instead of sleeping until an event arrives.  It lowers
+              the wake-up latency at the cost of a busy CPU core.
+  --connect-udp
+              Accept CONNECT-UDP  requests (RFC  9298), and  proxy the
+              HTTP Datagrams  to the  UDP  targets in  their  paths.
+              Any target is allowed, so that this must not be enabled
+              on a public network.
   -h, --help  Display this help and exit.
 
----
+---
+
+  The <SIZE> argument is an integer and an optional unit (e.g., 10K is
+  10 * 1024).  Units are K, M and G (powers of 1024).
+
+  The <DURATION> argument is an integer and an optional unit (e.g., 1s
+  is 1 second and 500ms is 500  milliseconds).  Units are h, m, s, ms,
+  us, or ns (hours,  minutes, seconds, milliseconds, microseconds, and
+  nanoseconds respectively).  If  a unit is omitted, a  second is used
+  as unit.
+
+  The  <HEX> argument  is an  hex string  which must  start with  "0x"
+  (e.g., 0x00000001).)"
+            << std::endl;
+}
+} // namespace
+
+namespace {
+// Worker runs Server on its own event loop in a dedicated thread.
+struct Worker {
+  ~Worker() {
+    server.reset();
+    if (loop) {
+      ev_loop_destroy(loop);
+    }
+  }
+
+  struct ev_loop *loop;
+  std::unique_ptr<Server> server;
+  ev_async stopev;
+  std::thread thread;
+};
+} // namespace
+
+namespace {
+void workerstopcb(struct ev_loop *loop, ev_async *w, int revents) {
+  ev_break(loop, EVBREAK_ALL);
+}
+} // namespace
+
+namespace {
+void workersiginthandler(struct ev_loop *loop, ev_signal *w, int revents) {
+  auto workers = static_cast<std::vector<std::unique_ptr<Worker>> *>(w->data);
+
+  for (auto &wk : *workers) {
+    ev_async_send(wk->loop, &wk->stopev);
+  }
+
+  ev_break(loop, EVBREAK_ALL);
+}
+} // namespace
+
+#ifdef HAVE_LIBBPF
+namespace {
+// attach_reuseport_bpf loads the eBPF program for each SO_REUSEPORT
+// group, fills its socket array with the sockets of |workers|, and
+// attaches it to the group.
+int attach_reuseport_bpf(const std::vector<std::unique_ptr<Worker>> &workers) {
+  auto nworkers = static_cast<uint32_t>(workers.size());
+  auto nep = workers[0]->server->endpoints().size();
+
+  for (size_t i = 0; i < nep; ++i) {
+    // The endpoints of the per-worker preferred addresses are not in
+    // any SO_REUSEPORT group.
+    if (workers[0]->server->endpoints()[i].worker_only) {
+      continue;
+    }
+
+    auto obj = bpf_object__open_file(config.bpf_program.data(), nullptr);
+    if (libbpf_get_error(obj)) {
+      std::cerr << "bpf_object__open_file: Could not open "
+                << std::quoted(config.bpf_program) << std::endl;
+      return -1;
+    }
+
+    auto obj_d = defer(bpf_object__close, obj);
+
+    if (bpf_object__load(obj) != 0) {
+      std::cerr << "bpf_object__load: Could not load "
+                << std::quoted(config.bpf_program) << std::endl;
+      return -1;
+    }
+
+    auto prog = bpf_object__find_program_by_name(obj, "select_reuseport");
+    auto reuseport_array =
+        bpf_object__find_map_by_name(obj, "reuseport_array");
+    auto worker_info = bpf_object__find_map_by_name(obj, "worker_info");
+    if (!prog || !reuseport_array || !worker_info) {
+      std::cerr << "bpf-program: program or maps not found" << std::endl;
+      return -1;
+    }
+
+    for (uint32_t wid = 0; wid < nworkers; ++wid) {
+      uint64_t fd = workers[wid]->server->endpoints()[i].fd;
+
+      if (bpf_map_update_elem(bpf_map__fd(reuseport_array), &wid, &fd,
+                              BPF_NOEXIST) != 0) {
+        std::cerr << "bpf_map_update_elem: " << strerror(errno) << std::endl;
+        return -1;
+      }
+    }
+
+    uint32_t key = 0;
+    if (bpf_map_update_elem(bpf_map__fd(worker_info), &key, &nworkers,
+                            BPF_ANY) != 0) {
+      std::cerr << "bpf_map_update_elem: " << strerror(errno) << std::endl;
+      return -1;
+    }
+
+    auto prog_fd = bpf_program__fd(prog);
+    if (setsockopt(workers[0]->server->endpoints()[i].fd, SOL_SOCKET,
+                   SO_ATTACH_REUSEPORT_EBPF, &prog_fd,
+                   static_cast<socklen_t>(sizeof(prog_fd))) == -1) {
+      std::cerr << "setsockopt: " << strerror(errno) << std::endl;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+} // namespace
+#endif // HAVE_LIBBPF
+
+namespace {
+void print_recv_stats(const RecvStats &st) {
+  std::cerr << "Receive stats: calls=" << st.ncall
+            << " full_batches=" << st.nfull << " datagrams=" << st.ndgram
+            << " packets=" << st.nseg << " max_batch=" << st.max_batch
+            << " kernel_drops=" << st.ndrop << std::endl;
+}
+} // namespace
+
+namespace {
+void print_send_stats(const SendStats &st) {
+  std::cerr << "Send stats: calls=" << st.ncall << " messages=" << st.nmsg
+            << " batches=" << st.nentry << " max_batch=" << st.max_batch
+            << " txbufs=" << st.ntxbuf << std::endl;
+}
+} // namespace
+
+namespace {
+void print_early_data_stats(const EarlyDataStats &st) {
+  if (!st.nsafe && !st.nunsafe && !st.ndeferred && !st.nrejected) {
+    return;
+  }
+
+  std::cerr << "Early data stats: safe=" << st.nsafe
+            << " unsafe=" << st.nunsafe << " deferred=" << st.ndeferred
+            << " rejected=" << st.nrejected << std::endl;
+}
+} // namespace
+
+namespace {
+void print_file_stats(const FileStats &st) {
+  std::cerr << "File stats: extents=" << st.nextent << " bytes=" << st.nbytes
+            << " prefetches=" << st.nprefetch
+            << " minor_faults=" << st.minflt
+            << " major_faults=" << st.majflt << std::endl;
+}
+} // namespace
+
+namespace {
+// add_page_faults adds the page faults that the calling thread has
+// taken to |st|.
+void add_page_faults(FileStats &st) {
+  rusage ru;
+
+#ifdef RUSAGE_THREAD
+  if (getrusage(RUSAGE_THREAD, &ru) != 0) {
+#else  // !defined(RUSAGE_THREAD)
+  if (getrusage(RUSAGE_SELF, &ru) != 0) {
+#endif // !defined(RUSAGE_THREAD)
+    return;
+  }
+
+  st.minflt += ru.ru_minflt;
+  st.majflt += ru.ru_majflt;
+}
+} // namespace
+
+namespace {
+// MetricsServer serves the metrics of all workers over HTTP/1.1 on
+// config.metrics_addr.  Any request is answered with the metrics,
+// and the connection is closed after the response.
+class MetricsServer {
+public:
+  explicit MetricsServer(struct ev_loop *loop) : loop_(loop), fd_(-1) {}
+  ~MetricsServer();
+
+  int init(const Address &addr);
+  void on_accept();
+
+  // MetricsConn is an accepted connection.
+  struct MetricsConn {
+    MetricsServer *server;
+    int fd;
+    ev_io rev;
+    ev_io wev;
+    // req is the request received so far.
+    std::string req;
+    // resp is the response, and off is the number of bytes of it
+    // written so far.
+    std::string resp;
+    size_t off;
+  };
+
+  void on_read(MetricsConn *c);
+  void on_write(MetricsConn *c);
+  void remove(MetricsConn *c);
+
+private:
+  struct ev_loop *loop_;
+  int fd_;
+  ev_io rev_;
+  std::vector<std::unique_ptr<MetricsConn>> conns_;
+};
+} // namespace
+
+namespace {
+void metricsacceptcb(struct ev_loop *loop, ev_io *w, int revents) {
+  static_cast<MetricsServer *>(w->data)->on_accept();
+}
+} // namespace
+
+namespace {
+void metricsreadcb(struct ev_loop *loop, ev_io *w, int revents) {
+  auto c = static_cast<MetricsServer::MetricsConn *>(w->data);
+
+  c->server->on_read(c);
+}
+} // namespace
+
+namespace {
+void metricswritecb(struct ev_loop *loop, ev_io *w, int revents) {
+  auto c = static_cast<MetricsServer::MetricsConn *>(w->data);
+
+  c->server->on_write(c);
+}
+} // namespace
+
+namespace {
+MetricsServer::~MetricsServer() {
+  while (!conns_.empty()) {
+    remove(conns_.back().get());
+  }
+
+  if (fd_ != -1) {
+    ev_io_stop(loop_, &rev_);
+    ::close(fd_);
+  }
+}
+} // namespace
+
+namespace {
+int MetricsServer::init(const Address &addr) {
+  fd_ = util::create_nonblock_socket(addr.su.storage.ss_family, SOCK_STREAM,
+                                     0);
+  if (fd_ == -1) {
+    std::cerr << "socket: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  int val = 1;
+  if (setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &val,
+                 static_cast<socklen_t>(sizeof(val))) == -1) {
+    std::cerr << "setsockopt: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  if (bind(fd_, &addr.su.sa, addr.len) == -1) {
+    std::cerr << "metrics-addr: bind: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  if (listen(fd_, 16) == -1) {
+    std::cerr << "metrics-addr: listen: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  ev_io_init(&rev_, metricsacceptcb, fd_, EV_READ);
+  rev_.data = this;
+  ev_io_start(loop_, &rev_);
+
+  return 0;
+}
+} // namespace
+
+namespace {
+void MetricsServer::on_accept() {
+  for (;;) {
+    auto fd = accept(fd_, nullptr, nullptr);
+    if (fd == -1) {
+      return;
+    }
+
+    if (util::make_socket_nonblocking(fd) != 0) {
+      ::close(fd);
+      continue;
+    }
+
+    auto c = std::make_unique<MetricsConn>();
+    c->server = this;
+    c->fd = fd;
+    c->off = 0;
+    ev_io_init(&c->rev, metricsreadcb, fd, EV_READ);
+    c->rev.data = c.get();
+    ev_io_init(&c->wev, metricswritecb, fd, EV_WRITE);
+    c->wev.data = c.get();
+    ev_io_start(loop_, &c->rev);
+
+    conns_.push_back(std::move(c));
+  }
+}
+} // namespace
+
+namespace {
+void MetricsServer::on_read(MetricsConn *c) {
+  std::array<char, 4096> buf;
+
+  for (;;) {
+    auto nread = read(c->fd, buf.data(), buf.size());
+    if (nread == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return;
+      }
+    }
+
+    if (nread <= 0) {
+      remove(c);
+      return;
+    }
+
+    c->req.append(buf.data(), static_cast<size_t>(nread));
+
+    if (c->req.find("\r\n\r\n") != std::string::npos) {
+      break;
+    }
+
+    if (c->req.size() > 16_k) {
+      remove(c);
+      return;
+    }
+  }
+
+  auto body = get_metrics_registry().format();
+
+  c->resp = "HTTP/1.1 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: " +
+            util::format_uint(body.size()) +
+            "\r\n"
+            "Connection: close\r\n"
+            "\r\n" +
+            body;
+
+  ev_io_stop(loop_, &c->rev);
+
+  on_write(c);
+}
+} // namespace
+
+namespace {
+void MetricsServer::on_write(MetricsConn *c) {
+  while (c->off < c->resp.size()) {
+    auto nwrite =
+        write(c->fd, c->resp.data() + c->off, c->resp.size() - c->off);
+    if (nwrite == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        ev_io_start(loop_, &c->wev);
+        return;
+      }
+
+      remove(c);
+      return;
+    }
+
+    c->off += static_cast<size_t>(nwrite);
+  }
+
+  remove(c);
+}
+} // namespace
+
+namespace {
+void MetricsServer::remove(MetricsConn *c) {
+  ev_io_stop(loop_, &c->rev);
+  ev_io_stop(loop_, &c->wev);
+  ::close(c->fd);
+
+  auto it = std::find_if(std::begin(conns_), std::end(conns_),
+                         [c](const auto &p) { return p.get() == c; });
+
+  assert(it != std::end(conns_));
+
+  conns_.erase(it);
+}
+} // namespace
+
+namespace {
+namespace {
+// pin_thread binds the calling thread to |cpu|.  It returns 0 if it
+// succeeds, or -1.
+int pin_thread(uint32_t cpu) {
+#ifdef CPU_SETSIZE
+  if (cpu >= CPU_SETSIZE) {
+    std::cerr << "worker-cpus: CPU " << cpu << " is out of range"
+              << std::endl;
+    return -1;
+  }
+
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+
+  if (auto rv = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+      rv != 0) {
+    std::cerr << "pthread_setaffinity_np: " << strerror(rv) << std::endl;
+    return -1;
+  }
+
+  return 0;
+#else  // !defined(CPU_SETSIZE)
+  std::cerr << "worker-cpus: CPU affinity is not supported" << std::endl;
+  return -1;
+#endif // !defined(CPU_SETSIZE)
+}
+} // namespace
+
+int run_workers(const char *addr, const char *port,
+                TLSServerContext &tls_ctx) {
+  std::vector<std::unique_ptr<Worker>> workers;
+
+#ifdef CPU_SETSIZE
+  cpu_set_t main_cpus;
+
+  if (!config.worker_cpus.empty() &&
+      pthread_getaffinity_np(pthread_self(), sizeof(main_cpus), &main_cpus) !=
+          0) {
+    CPU_ZERO(&main_cpus);
+  }
+#endif // defined(CPU_SETSIZE)
+
+  for (size_t i = 0; i < config.workers; ++i) {
+    // Create Server on the CPU of the worker, so that the memory it
+    // touches during initialization, such as receive buffers, is
+    // allocated from the NUMA node local to that CPU by the
+    // first-touch policy.  Connections are allocated by the worker
+    // thread itself later.
+    if (!config.worker_cpus.empty() &&
+        pin_thread(config.worker_cpus[i]) != 0) {
+      return -1;
+    }
+
+    auto w = std::make_unique<Worker>();
+    w->loop = new_event_loop(config.event_loop);
+    if (!w->loop) {
+      std::cerr << "ev_loop_new: Could not create event loop" << std::endl;
+      return -1;
+    }
+
+    w->server =
+        std::make_unique<Server>(w->loop, tls_ctx, static_cast<uint8_t>(i));
+    if (w->server->init(addr, port) != 0) {
+      return -1;
+    }
+
+    ev_async_init(&w->stopev, workerstopcb);
+    ev_async_start(w->loop, &w->stopev);
+
+    workers.push_back(std::move(w));
+  }
+
+#ifdef CPU_SETSIZE
+  if (!config.worker_cpus.empty() && CPU_COUNT(&main_cpus)) {
+    pthread_setaffinity_np(pthread_self(), sizeof(main_cpus), &main_cpus);
+  }
+#endif // defined(CPU_SETSIZE)
+
+  if (!config.bpf_program.empty()) {
+#ifdef HAVE_LIBBPF
+    if (attach_reuseport_bpf(workers) != 0) {
+      return -1;
+    }
+#else  // !defined(HAVE_LIBBPF)
+    std::cerr << "bpf-program: built without libbpf, packets are "
+                 "distributed by the kernel"
+              << std::endl;
+#endif // !defined(HAVE_LIBBPF)
+  }
+
+  ev_signal sigintev;
+  ev_signal_init(&sigintev, workersiginthandler, SIGINT);
+  sigintev.data = &workers;
+  ev_signal_start(EV_DEFAULT, &sigintev);
+
+  for (size_t i = 0; i < workers.size(); ++i) {
+    auto w = workers[i].get();
+
+    w->thread = std::thread([w, i]() {
+      if (!config.worker_cpus.empty()) {
+        pin_thread(config.worker_cpus[i]);
+      }
 
-  The <SIZE> argument is an integer and an optional unit (e.g., 10K is
-  10 * 1024).  Units are K, M and G (powers of 1024).
+      run_event_loop(w->loop, config.event_loop);
 
-  The <DURATION> argument is an integer and an optional unit (e.g., 1s
-  is 1 second and 500ms is 500  milliseconds).  Units are h, m, s, ms,
-  us, or ns (hours,  minutes, seconds, milliseconds, microseconds, and
-  nanoseconds respectively).  If  a unit is omitted, a  second is used
-  as unit.
+      if (config.file_extent) {
+        add_page_faults(w->server->file_stats());
+      }
+    });
+  }
 
-  The  <HEX> argument  is an  hex string  which must  start with  "0x"
-  (e.g., 0x00000001).)"
-            << std::endl;
+  run_event_loop(EV_DEFAULT, config.event_loop);
+
+  ev_signal_stop(EV_DEFAULT, &sigintev);
+
+  RecvStats st{};
+  SendStats tst{};
+  FileStats fst{};
+  EarlyDataStats est{};
+
+  for (auto &w : workers) {
+    w->thread.join();
+
+    w->server->disconnect();
+    w->server->close();
+
+    auto &wst = w->server->recv_stats();
+    st.ncall += wst.ncall;
+    st.nfull += wst.nfull;
+    st.ndgram += wst.ndgram;
+    st.nseg += wst.nseg;
+    st.max_batch = std::max(st.max_batch, wst.max_batch);
+    st.ndrop += wst.ndrop;
+
+    auto &wtst = w->server->send_stats();
+    tst.ncall += wtst.ncall;
+    tst.nmsg += wtst.nmsg;
+    tst.nentry += wtst.nentry;
+    tst.max_batch = std::max(tst.max_batch, wtst.max_batch);
+    tst.ntxbuf += wtst.ntxbuf;
+
+    auto &wfst = w->server->file_stats();
+    fst.nextent += wfst.nextent;
+    fst.nbytes += wfst.nbytes;
+    fst.nprefetch += wfst.nprefetch;
+    fst.minflt += wfst.minflt;
+    fst.majflt += wfst.majflt;
+
+    auto &west = w->server->early_data_stats();
+    est.nsafe += west.nsafe;
+    est.nunsafe += west.nunsafe;
+    est.ndeferred += west.ndeferred;
+    est.nrejected += west.nrejected;
+  }
+
+  if (config.recv_batch > 1 || config.gro || st.ndrop) {
+    print_recv_stats(st);
+  }
+
+  if (config.send_batch > 1) {
+    print_send_stats(tst);
+  }
+
+  if (config.file_extent) {
+    print_file_stats(fst);
+  }
+
+  print_early_data_stats(est);
+
+  return 0;
 }
 } // namespace
 
@@ -3350,6 +7357,47 @@ int main(int argc, char **argv) {
         {"other-versions", required_argument, &flag, 28},
         {"no-pmtud", no_argument, &flag, 29},
         {"ack-thresh", required_argument, &flag, 30},
+        {"recv-batch", required_argument, &flag, 31},
+        {"gro", no_argument, &flag, 32},
+        {"workers", required_argument, &flag, 33},
+        {"bpf-program", required_argument, &flag, 34},
+        {"send-batch", required_argument, &flag, 35},
+        {"io-uring", no_argument, &flag, 36},
+        {"txtime", required_argument, &flag, 37},
+        {"timer-wheel", no_argument, &flag, 38},
+        {"qlog-binary", no_argument, &flag, 39},
+        {"qlog-compress", no_argument, &flag, 40},
+        {"anti-replay", no_argument, &flag, 41},
+        {"file-extent", required_argument, &flag, 42},
+        {"file-cache-size", required_argument, &flag, 43},
+        {"dyn-pattern", no_argument, &flag, 44},
+        {"pmtud-search", no_argument, &flag, 45},
+        {"quic-lb-server-id", required_argument, &flag, 46},
+        {"quic-lb-config-id", required_argument, &flag, 47},
+        {"quic-lb-key", required_argument, &flag, 48},
+        {"retry-half-open", required_argument, &flag, 49},
+        {"initial-rate", required_argument, &flag, 50},
+        {"fast-nat-rebinding", no_argument, &flag, 51},
+        {"preferred-addr-per-worker", no_argument, &flag, 52},
+        {"unsafe-early-request", required_argument, &flag, 53},
+        {"metrics-addr", required_argument, &flag, 54},
+        {"xdp", required_argument, &flag, 55},
+        {"xdp-program", required_argument, &flag, 56},
+        {"xdp-queue", required_argument, &flag, 57},
+        {"dpdk", required_argument, &flag, 58},
+        {"dpdk-eal", required_argument, &flag, 59},
+        {"worker-cpus", required_argument, &flag, 60},
+        {"busy-poll", required_argument, &flag, 61},
+        {"sock-buf-max", required_argument, &flag, 62},
+        {"event-loop", required_argument, &flag, 63},
+        {"event-loop-busy-poll", no_argument, &flag, 64},
+        {"keep-alive", required_argument, &flag, 65},
+        {"trace-dir", required_argument, &flag, 66},
+        {"netem", required_argument, &flag, 67},
+        {"connect-udp", no_argument, &flag, 68},
+        {"spin-bit", no_argument, &flag, 69},
+        {"pto-probe-policy", required_argument, &flag, 70},
+        {"qlog-ring", required_argument, &flag, 71},
         {nullptr, 0, nullptr, 0}};
 
     auto optidx = 0;
@@ -3540,7 +7588,12 @@ int main(int argc, char **argv) {
           config.cc_algo = NGTCP2_CC_ALGO_BBR2;
           break;
         }
-        std::cerr << "cc: specify cubic, reno, bbr, or bbr2" << std::endl;
+        if (strcmp("prague", optarg) == 0) {
+          config.cc_algo = NGTCP2_CC_ALGO_PRAGUE;
+          break;
+        }
+        std::cerr << "cc: specify cubic, reno, bbr, bbr2, or prague"
+                  << std::endl;
         exit(EXIT_FAILURE);
       case 20:
         // --initial-rtt
@@ -3677,6 +7730,364 @@ int main(int argc, char **argv) {
           config.ack_thresh = *n;
         }
         break;
+      case 31:
+        // --recv-batch
+        if (auto n = util::parse_uint(optarg); !n || *n == 0) {
+          std::cerr << "recv-batch: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else if (*n > 1024) {
+          std::cerr << "recv-batch: must not exceed 1024" << std::endl;
+          exit(EXIT_FAILURE);
+#ifndef HAVE_RECVMMSG
+        } else if (*n > 1) {
+          std::cerr << "recv-batch: recvmmsg is not available" << std::endl;
+          exit(EXIT_FAILURE);
+#endif // !defined(HAVE_RECVMMSG)
+        } else {
+          config.recv_batch = *n;
+        }
+        break;
+      case 32:
+        // --gro
+        config.gro = true;
+        break;
+      case 33:
+        // --workers
+        if (auto n = util::parse_uint(optarg); !n || *n == 0) {
+          std::cerr << "workers: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else if (*n > 255) {
+          std::cerr << "workers: must not exceed 255" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.workers = *n;
+        }
+        break;
+      case 34:
+        // --bpf-program
+        config.bpf_program = optarg;
+        break;
+      case 35:
+        // --send-batch
+        if (auto n = util::parse_uint(optarg); !n || *n == 0) {
+          std::cerr << "send-batch: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else if (*n > 1024) {
+          std::cerr << "send-batch: must not exceed 1024" << std::endl;
+          exit(EXIT_FAILURE);
+#ifndef HAVE_SENDMMSG
+        } else if (*n > 1) {
+          std::cerr << "send-batch: sendmmsg is not available" << std::endl;
+          exit(EXIT_FAILURE);
+#endif // !defined(HAVE_SENDMMSG)
+        } else {
+          config.send_batch = *n;
+        }
+        break;
+      case 36:
+        // --io-uring
+#ifndef HAVE_LIBURING
+        std::cerr << "io-uring: built without liburing" << std::endl;
+        exit(EXIT_FAILURE);
+#endif // !defined(HAVE_LIBURING)
+        config.io_uring = true;
+        break;
+      case 37:
+        // --txtime
+        if (auto t = util::parse_duration(optarg); !t) {
+          std::cerr << "txtime: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.txtime = *t;
+        }
+        break;
+      case 38:
+        // --timer-wheel
+        config.timer_wheel = true;
+        break;
+      case 39:
+        // --qlog-binary
+        config.qlog_binary = true;
+        break;
+      case 40:
+        // --qlog-compress
+        config.qlog_compress = true;
+        break;
+      case 41:
+        // --anti-replay
+        config.anti_replay = true;
+        break;
+      case 42:
+        // --file-extent
+        if (auto n = util::parse_uint_iec(optarg); !n) {
+          std::cerr << "file-extent: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.file_extent = *n;
+        }
+        break;
+      case 43:
+        // --file-cache-size
+        if (auto n = util::parse_uint_iec(optarg); !n) {
+          std::cerr << "file-cache-size: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.file_cache_size = *n;
+        }
+        break;
+      case 44:
+        // --dyn-pattern
+        config.dyn_pattern = true;
+        break;
+      case 45:
+        // --pmtud-search
+        config.pmtud_search = true;
+        break;
+      case 46: {
+        // --quic-lb-server-id
+        auto s = std::string_view{optarg};
+        if (s.empty() || s.size() % 2 ||
+            !std::all_of(std::begin(s), std::end(s), util::is_hex_digit)) {
+          std::cerr << "quic-lb-server-id: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        }
+        if (s.size() / 2 > NGTCP2_SV_SCIDLEN - 1 -
+                               NGTCP2_CRYPTO_QUIC_LB_MIN_NONCELEN) {
+          std::cerr << "quic-lb-server-id: must not exceed "
+                    << NGTCP2_SV_SCIDLEN - 1 -
+                           NGTCP2_CRYPTO_QUIC_LB_MIN_NONCELEN
+                    << " bytes" << std::endl;
+          exit(EXIT_FAILURE);
+        }
+        config.quic_lb_server_id = util::decode_hex(s);
+        break;
+      }
+      case 47:
+        // --quic-lb-config-id
+        if (auto n = util::parse_uint(optarg); !n) {
+          std::cerr << "quic-lb-config-id: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else if (*n > NGTCP2_CRYPTO_QUIC_LB_MAX_CONFIG_ID) {
+          std::cerr << "quic-lb-config-id: must not exceed "
+                    << NGTCP2_CRYPTO_QUIC_LB_MAX_CONFIG_ID << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.quic_lb_config_id = *n;
+        }
+        break;
+      case 48:
+        // --quic-lb-key
+        config.quic_lb_key = optarg;
+        break;
+      case 49:
+        // --retry-half-open
+        if (auto n = util::parse_uint(optarg); !n) {
+          std::cerr << "retry-half-open: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.retry_half_open = *n;
+        }
+        break;
+      case 50:
+        // --initial-rate
+        if (auto n = util::parse_uint(optarg); !n) {
+          std::cerr << "initial-rate: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.initial_rate = *n;
+        }
+        break;
+      case 51:
+        // --fast-nat-rebinding
+        config.fast_nat_rebinding = true;
+        break;
+      case 52:
+        // --preferred-addr-per-worker
+        config.preferred_addr_per_worker = true;
+        break;
+      case 53:
+        // --unsafe-early-request
+        if (strcmp("accept", optarg) == 0) {
+          config.unsafe_early_request = EarlyRequestPolicy::ACCEPT;
+          break;
+        }
+        if (strcmp("defer", optarg) == 0) {
+          config.unsafe_early_request = EarlyRequestPolicy::DEFER;
+          break;
+        }
+        if (strcmp("reject", optarg) == 0) {
+          config.unsafe_early_request = EarlyRequestPolicy::REJECT;
+          break;
+        }
+        std::cerr << "unsafe-early-request: specify accept, defer, or reject"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+      case 54:
+        // --metrics-addr
+        if (parse_host_port(config.metrics_addr, AF_UNSPEC, optarg,
+                            optarg + strlen(optarg)) != 0) {
+          std::cerr << "metrics-addr: could not use "
+                    << std::quoted(optarg) << std::endl;
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 55:
+        // --xdp
+#ifndef HAVE_LIBBPF
+        std::cerr << "xdp: built without libbpf" << std::endl;
+        exit(EXIT_FAILURE);
+#endif // !defined(HAVE_LIBBPF)
+        config.xdp_ifname = optarg;
+        break;
+      case 56:
+        // --xdp-program
+        config.xdp_program = optarg;
+        break;
+      case 57:
+        // --xdp-queue
+        if (auto n = util::parse_uint(optarg); !n) {
+          std::cerr << "xdp-queue: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else if (*n > std::numeric_limits<uint32_t>::max()) {
+          std::cerr << "xdp-queue: must not exceed "
+                    << std::numeric_limits<uint32_t>::max() << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.xdp_queue = *n;
+        }
+        break;
+      case 58:
+        // --dpdk
+#ifndef HAVE_LIBDPDK
+        std::cerr << "dpdk: built without libdpdk" << std::endl;
+        exit(EXIT_FAILURE);
+#endif // !defined(HAVE_LIBDPDK)
+        if (auto n = util::parse_uint(optarg); !n) {
+          std::cerr << "dpdk: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else if (*n > std::numeric_limits<uint16_t>::max()) {
+          std::cerr << "dpdk: must not exceed "
+                    << std::numeric_limits<uint16_t>::max() << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.dpdk = true;
+          config.dpdk_port_id = static_cast<uint16_t>(*n);
+        }
+        break;
+      case 59:
+        // --dpdk-eal
+        config.dpdk_eal_args = optarg;
+        break;
+      case 60:
+        // --worker-cpus
+        if (auto cpus = util::parse_cpu_list(optarg); !cpus) {
+          std::cerr << "worker-cpus: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.worker_cpus = std::move(*cpus);
+        }
+        break;
+      case 61:
+        // --busy-poll
+        if (auto t = util::parse_duration(optarg); !t) {
+          std::cerr << "busy-poll: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else if (*t / NGTCP2_MICROSECONDS >
+                   static_cast<uint64_t>(std::numeric_limits<int>::max())) {
+          std::cerr << "busy-poll: too large" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.busy_poll = static_cast<uint32_t>(*t / NGTCP2_MICROSECONDS);
+        }
+        break;
+      case 62:
+        // --sock-buf-max
+        if (auto n = util::parse_uint_iec(optarg); !n) {
+          std::cerr << "sock-buf-max: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else if (*n >
+                   static_cast<uint64_t>(std::numeric_limits<int>::max())) {
+          std::cerr << "sock-buf-max: too large" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.sock_buf_max = static_cast<size_t>(*n);
+        }
+        break;
+      case 63:
+        // --event-loop
+        if (auto b = parse_event_loop_backend(optarg); !b) {
+          std::cerr << "event-loop: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.event_loop.backend = *b;
+        }
+        break;
+      case 64:
+        // --event-loop-busy-poll
+        config.event_loop.busy_poll = true;
+        break;
+      case 65:
+        // --keep-alive
+        if (auto t = util::parse_duration(optarg); !t) {
+          std::cerr << "keep-alive: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.keep_alive_timeout = *t;
+        }
+        break;
+      case 66:
+        // --trace-dir
+        config.trace_dir = optarg;
+        break;
+      case 67:
+        // --netem
+        if (auto c = parse_netem_config(optarg); !c) {
+          std::cerr << "netem: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.netem = *c;
+        }
+        break;
+      case 68:
+        // --connect-udp
+#if !defined(HAVE_RECVMMSG) || !defined(HAVE_SENDMMSG)
+        std::cerr << "connect-udp: recvmmsg and sendmmsg are not available"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+#endif // !defined(HAVE_RECVMMSG) || !defined(HAVE_SENDMMSG)
+        config.connect_udp = true;
+        break;
+      case 69:
+        // --spin-bit
+        config.spin_bit = true;
+        break;
+      case 70:
+        // --pto-probe-policy
+        if (strcmp("new-data-first", optarg) == 0) {
+          config.pto_probe_policy = NGTCP2_PTO_PROBE_POLICY_NEW_DATA_FIRST;
+          break;
+        }
+        if (strcmp("retransmit-oldest", optarg) == 0) {
+          config.pto_probe_policy = NGTCP2_PTO_PROBE_POLICY_RETRANSMIT_OLDEST;
+          break;
+        }
+        if (strcmp("duplicate-latest", optarg) == 0) {
+          config.pto_probe_policy = NGTCP2_PTO_PROBE_POLICY_DUPLICATE_LATEST;
+          break;
+        }
+        std::cerr << "pto-probe-policy: specify new-data-first, "
+                     "retransmit-oldest, or duplicate-latest"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+      case 71:
+        // --qlog-ring
+        if (auto n = util::parse_uint_iec(optarg); !n || *n == 0) {
+          std::cerr << "qlog-ring: invalid argument" << std::endl;
+          exit(EXIT_FAILURE);
+        } else {
+          config.qlog_ring_size = *n;
+        }
+        break;
       }
       break;
     default:
@@ -3684,6 +8095,63 @@ int main(int argc, char **argv) {
     };
   }
 
+  if (config.qlog_ring_size) {
+    if (config.qlog_dir.empty()) {
+      std::cerr << "qlog-ring: requires qlog-dir" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    if (config.qlog_compress) {
+      std::cerr << "qlog-ring and qlog-compress are mutually exclusive"
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (!config.quic_lb_server_id.empty() && config.workers > 1) {
+    std::cerr << "quic-lb-server-id: cannot be used with multiple workers"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (!config.xdp_ifname.empty()) {
+    if (config.xdp_program.empty()) {
+      std::cerr << "xdp: --xdp-program is required" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    if (config.io_uring) {
+      std::cerr << "xdp: cannot be used with --io-uring" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    if (config.send_batch > 1) {
+      std::cerr << "xdp: cannot be used with --send-batch greater than 1"
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (!config.worker_cpus.empty() &&
+      config.worker_cpus.size() < config.workers) {
+    std::cerr << "worker-cpus: " << config.workers
+              << " CPUs are required for --workers" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (config.dpdk) {
+    if (!config.xdp_ifname.empty()) {
+      std::cerr << "dpdk: cannot be used with --xdp" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    if (config.io_uring) {
+      std::cerr << "dpdk: cannot be used with --io-uring" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    if (config.send_batch > 1) {
+      std::cerr << "dpdk: cannot be used with --send-batch greater than 1"
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
   if (argc - optind < 4) {
     std::cerr << "Too few arguments" << std::endl;
     print_usage();
@@ -3724,10 +8192,17 @@ int main(int argc, char **argv) {
 
   std::cerr << "Using document root " << config.htdocs << std::endl;
 
+  if (!init_default_event_loop(config.event_loop)) {
+    std::cerr << "ev_default_loop: Could not create event loop" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
   auto ev_loop_d = defer(ev_loop_destroy, EV_DEFAULT);
 
   auto keylog_filename = getenv("SSLKEYLOGFILE");
-  if (keylog_filename) {
+  if (keylog_filename && config.workers > 1) {
+    std::cerr << "SSLKEYLOGFILE is ignored with multiple workers" << std::endl;
+  } else if (keylog_filename) {
     keylog_file.open(keylog_filename, std::ios_base::app);
     if (keylog_file) {
       tls_ctx.enable_keylog();
@@ -3740,15 +8215,99 @@ int main(int argc, char **argv) {
     exit(EXIT_FAILURE);
   }
 
+  // Declared before the workers and Server, so that it outlives all
+  // Handlers.
+  QlogSink qs;
+
+  if (!config.qlog_dir.empty()) {
+    if (config.qlog_ring_size) {
+      if (qs.start_ring(std::string{config.qlog_dir}, config.qlog_ring_size) !=
+          0) {
+        exit(EXIT_FAILURE);
+      }
+    } else if (qs.start(config.qlog_compress) != 0) {
+      exit(EXIT_FAILURE);
+    }
+
+    qlog_sink = &qs;
+  }
+
+#ifdef HAVE_LIBBPF
+  // Declared before the workers and Server, so that the program stays
+  // attached while their AF_XDP sockets are open.
+  XdpProgram xdp_prog;
+
+  if (!config.xdp_ifname.empty()) {
+    if (xdp_prog.init(config.xdp_program.data(), config.xdp_ifname.data(),
+                      config.port) != 0) {
+      exit(EXIT_FAILURE);
+    }
+
+    xdp_program = &xdp_prog;
+  }
+#endif // HAVE_LIBBPF
+
+#ifdef HAVE_LIBDPDK
+  // Declared before the workers and Server, so that the port is
+  // stopped after all queues are released.
+  DpdkPort dpdk;
+
+  if (config.dpdk) {
+    if (dpdk.init(config.dpdk_eal_args, config.dpdk_port_id,
+                  static_cast<uint16_t>(config.workers), config.port) != 0) {
+      exit(EXIT_FAILURE);
+    }
+
+    dpdk_port = &dpdk;
+  }
+#endif // HAVE_LIBDPDK
+
+  MetricsServer metrics_server(EV_DEFAULT);
+
+  if (config.metrics_addr.len &&
+      metrics_server.init(config.metrics_addr) != 0) {
+    exit(EXIT_FAILURE);
+  }
+
+  if (config.workers > 1) {
+    if (run_workers(addr, port, tls_ctx) != 0) {
+      exit(EXIT_FAILURE);
+    }
+
+    return EXIT_SUCCESS;
+  }
+
+  if (!config.worker_cpus.empty() && pin_thread(config.worker_cpus[0]) != 0) {
+    exit(EXIT_FAILURE);
+  }
+
   Server s(EV_DEFAULT, tls_ctx);
   if (s.init(addr, port) != 0) {
     exit(EXIT_FAILURE);
   }
 
-  ev_run(EV_DEFAULT, 0);
+  run_event_loop(EV_DEFAULT, config.event_loop);
+
+  if (config.file_extent) {
+    add_page_faults(s.file_stats());
+  }
 
   s.disconnect();
   s.close();
 
+  if (config.recv_batch > 1 || config.gro || s.recv_stats().ndrop) {
+    print_recv_stats(s.recv_stats());
+  }
+
+  if (config.send_batch > 1) {
+    print_send_stats(s.send_stats());
+  }
+
+  if (config.file_extent) {
+    print_file_stats(s.file_stats());
+  }
+
+  print_early_data_stats(s.early_data_stats());
+
   return EXIT_SUCCESS;
 }
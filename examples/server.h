@@ -35,6 +35,9 @@
 #include <deque>
 #include <string_view>
 #include <memory>
+#include <array>
+
+#include <sys/uio.h>
 
 #include <ngtcp2/ngtcp2.h>
 #include <ngtcp2/ngtcp2_crypto.h>
@@ -42,10 +45,23 @@
 
 #include <ev.h>
 
+#ifdef HAVE_LIBURING
+#  include <liburing.h>
+#endif // HAVE_LIBURING
+
 #include "server_base.h"
 #include "tls_server_context.h"
 #include "network.h"
 #include "shared.h"
+#include "cid_map.h"
+#include "timer_wheel.h"
+#include "qlog_sink.h"
+#include "pkt_trace.h"
+#include "metrics.h"
+#include "xdp.h"
+#include "dpdk.h"
+#include "util.h"
+#include "http.h"
 
 using namespace ngtcp2;
 
@@ -59,12 +75,85 @@ struct HTTPHeader {
 
 class Handler;
 struct FileEntry;
+struct Stream;
+
+// udp_proxy_nslot is the number of UDP datagrams from the target of
+// CONNECT-UDP which UDPProxy buffers until they are sent to client.
+constexpr size_t udp_proxy_nslot = 64;
+// udp_proxy_slotsize is the maximum length of UDP datagram which
+// UDPProxy forwards to client.  A longer one does not fit in a QUIC
+// packet anyway.
+constexpr size_t udp_proxy_slotsize = 1500;
+// max_preferred_versionslen is the maximum number of versions which
+// --preferred-versions takes.
+constexpr size_t max_preferred_versionslen = 4;
+
+// UDPProxy is the UDP socket of CONNECT-UDP stream which is connected
+// to the target.
+struct UDPProxy {
+  UDPProxy(struct ev_loop *loop, Stream *stream, int fd);
+  ~UDPProxy();
+
+  // on_read receives the datagrams from the target into the free
+  // slots of rx with recvmmsg.
+  void on_read();
+  // queue_tx queues |data| of length |datalen| which is sent to the
+  // target by flush_tx.  |data| is not copied.
+  void queue_tx(const uint8_t *data, size_t datalen);
+  // flush_tx sends the queued datagrams to the target with sendmmsg.
+  // The datagrams which the socket cannot take are dropped.
+  void flush_tx();
+  // rx_front returns the oldest datagram in rx.  rx must not be
+  // empty.
+  ngtcp2_vec rx_front();
+  // pop_rx removes the oldest datagram from rx.
+  void pop_rx();
+
+  struct ev_loop *loop;
+  Stream *stream;
+  int fd;
+  ev_io rev;
+  // header is Quarter Stream ID and Context ID 0 which precede the
+  // payload of each HTTP Datagram sent to client.
+  std::array<uint8_t, http::HTTP_DATAGRAM_MAX_HEADERLEN> header;
+  size_t headerlen;
+
+  struct {
+    // iovs is the payloads of the HTTP Datagrams received from
+    // client.  They point into the receive buffer of Server, and
+    // must be flushed before the buffer is reused.
+    std::vector<iovec> iovs;
+    // queued is true if this object is in the flush list of Server.
+    bool queued;
+  } tx;
+
+  struct {
+    // data is the ring of udp_proxy_nslot slots, each of which is
+    // udp_proxy_slotsize bytes long.
+    std::unique_ptr<uint8_t[]> data;
+    // lens is the length of the datagram in each slot.
+    std::array<size_t, udp_proxy_nslot> lens;
+    // head is the index of the oldest slot, and len is the number of
+    // slots in use.
+    size_t head;
+    size_t len;
+    // queued is true if this object is in the write queue of
+    // Handler.
+    bool queued;
+  } rx;
+};
 
 struct Stream {
   Stream(int64_t stream_id, Handler *handler);
 
   int start_response(nghttp3_conn *conn);
-  std::pair<FileEntry, int> open_file(const std::string &path);
+  // start_connect_udp opens the UDP socket to the target of
+  // CONNECT-UDP request, and responds to it.
+  int start_connect_udp(nghttp3_conn *conn);
+  // close_connect_udp closes the UDP socket of CONNECT-UDP stream,
+  // and ends the response.
+  int close_connect_udp(nghttp3_conn *conn);
+  std::shared_ptr<FileEntry> open_file(const std::string &path);
   void map_file(const FileEntry &fe);
   int send_status_response(nghttp3_conn *conn, unsigned int status_code,
                            const std::vector<HTTPHeader> &extra_headers = {});
@@ -79,17 +168,37 @@ struct Stream {
   std::string uri;
   std::string method;
   std::string authority;
+  // protocol is the value of :protocol pseudo header field of
+  // extended CONNECT request.
+  std::string protocol;
+  // range is the value of range header field.
+  std::string range;
   std::string status_resp_body;
   // data is a pointer to the memory which maps file denoted by fd.
+  // It is advanced as the data is handed to nghttp3.
   uint8_t *data;
-  // datalen is the length of mapped file by data.
+  // datalen is the length of mapped file by data which has not been
+  // handed to nghttp3 yet.
   uint64_t datalen;
+  // mapped is true if data points to a file mapping.
+  bool mapped;
+  // file is the served file.  It keeps the mapping alive while the
+  // stream is sending it.
+  std::shared_ptr<FileEntry> file;
   // dynresp is true if dynamic data response is enabled.
   bool dynresp;
   // dyndataleft is the number of dynamic data left to send.
   uint64_t dyndataleft;
   // dynbuflen is the number of bytes in-flight.
   uint64_t dynbuflen;
+  // dynoff is the offset in DynPattern where the next chunk of the
+  // dynamic response starts.
+  size_t dynoff;
+  // dyn_checksum is the value of x-ngtcp2-checksum trailer field.
+  std::string dyn_checksum;
+  // udp_proxy is the UDP socket to the target while CONNECT-UDP
+  // tunnel is open.
+  std::unique_ptr<UDPProxy> udp_proxy;
 };
 
 class Server;
@@ -102,6 +211,11 @@ struct Endpoint {
   int fd;
   // ecn is the last ECN bits set to fd.
   unsigned int ecn;
+  // rxq_drops is the last SO_RXQ_OVFL counter received from fd.
+  uint32_t rxq_drops;
+  // worker_only is true if fd is bound only by this worker, and does
+  // not belong to the SO_REUSEPORT group shared by the workers.
+  bool worker_only;
 };
 
 class Handler : public HandlerBase {
@@ -112,22 +226,41 @@ public:
   int init(const Endpoint &ep, const Address &local_addr, const sockaddr *sa,
            socklen_t salen, const ngtcp2_cid *dcid, const ngtcp2_cid *scid,
            const ngtcp2_cid *ocid, const uint8_t *token, size_t tokenlen,
-           uint32_t version, TLSServerContext &tls_ctx);
+           const ngtcp2_cc_resume_params &cc_resume, uint32_t version,
+           TLSServerContext &tls_ctx);
 
+  // on_read processes datagrams in |data| of length |datalen|.  Each
+  // datagram is |gso_size| bytes long except for the last one.
   int on_read(const Endpoint &ep, const Address &local_addr, const sockaddr *sa,
               socklen_t salen, const ngtcp2_pkt_info *pi, uint8_t *data,
-              size_t datalen);
+              size_t datalen, size_t gso_size);
   int on_write();
   int write_streams();
   int feed_data(const Endpoint &ep, const Address &local_addr,
                 const sockaddr *sa, socklen_t salen, const ngtcp2_pkt_info *pi,
-                uint8_t *data, size_t datalen);
+                uint8_t *data, size_t datalen, size_t gso_size);
   void update_timer();
+  // update_bdp reports the change of the congestion window to Server
+  // which sizes the socket buffers after it.
+  void update_bdp();
   int handle_expiry();
   void signal_write();
   int handshake_completed();
+  // start_deferred_responses starts the responses to the requests
+  // which were held because they were received in 0-RTT.
+  int start_deferred_responses();
+  // set_half_open marks this connection half-open until the handshake
+  // completes or it is removed.
+  void set_half_open();
+  // submit_new_token sends NEW_TOKEN whose opaque data carries the
+  // congestion control state of the current path.
+  int submit_new_token();
+  // send_keep_alive sends a packet which only contains PING.
+  int send_keep_alive();
+  TimerWheelEntry *keep_alive_entry();
 
   Server *server() const;
+  struct ev_loop *loop() const;
   int recv_stream_data(uint32_t flags, int64_t stream_id, const uint8_t *data,
                        size_t datalen);
   int acked_stream_data_offset(int64_t stream_id, uint64_t datalen);
@@ -138,12 +271,27 @@ public:
   int start_closing_period();
   int handle_error();
   int send_conn_close();
+  // conn_closebuf returns the packet which contains
+  // CONNECTION_CLOSE, or nullptr if it has not been written.
+  const Buffer *conn_closebuf() const;
 
   int update_key(uint8_t *rx_secret, uint8_t *tx_secret,
                  ngtcp2_crypto_aead_ctx *rx_aead_ctx, uint8_t *rx_iv,
                  ngtcp2_crypto_aead_ctx *tx_aead_ctx, uint8_t *tx_iv,
                  const uint8_t *current_rx_secret,
                  const uint8_t *current_tx_secret, size_t secretlen);
+  void release_aead_ctx(ngtcp2_crypto_aead_ctx *aead_ctx);
+  // recv_datagram forwards HTTP Datagram |data| of length |datalen|
+  // to the UDP socket of its CONNECT-UDP stream.
+  void recv_datagram(const uint8_t *data, size_t datalen);
+  // queue_proxy_rx schedules to send the datagrams that |proxy| has
+  // received from the target.
+  void queue_proxy_rx(UDPProxy *proxy);
+  // pop_proxy_rx removes the oldest datagram of |proxy| which is at
+  // the front of the write queue after it is sent.
+  void pop_proxy_rx(UDPProxy *proxy);
+  // remove_proxy_rx removes |proxy| from the write queue.
+  void remove_proxy_rx(UDPProxy *proxy);
 
   int setup_httpconn();
   void http_consume(int64_t stream_id, size_t nconsumed);
@@ -168,18 +316,60 @@ public:
 
   void on_send_blocked(Endpoint &ep, const ngtcp2_addr &local_addr,
                        const ngtcp2_addr &remote_addr, unsigned int ecn,
-                       const uint8_t *data, size_t datalen, size_t gso_size);
+                       const uint8_t *data, size_t datalen, size_t gso_size,
+                       uint64_t txtime);
   void start_wev_endpoint(const Endpoint &ep);
   int send_blocked_packet();
+  // protect_pkts protects 1RTT packets written to the tx buffer whose
+  // protection is deferred by ngtcp2.  It must be called before the
+  // buffer is sent.
+  int protect_pkts();
+  // prepare_rx_hp_masks precomputes header protection masks of 1RTT
+  // packets in |pktv| of length |pktvcnt| in bulk.
+  void prepare_rx_hp_masks(const ngtcp2_vec *pktv, size_t pktvcnt);
+  // send_packet sends |data| of length |datalen|, or queues it to the
+  // transmit scheduler of Server if --send-batch is greater than 1.
+  // If |txtime| is nonzero, it is the earliest departure time of
+  // |data| passed to the kernel with SCM_TXTIME.
+  std::pair<size_t, int> send_packet(Endpoint &ep,
+                                     const ngtcp2_addr &local_addr,
+                                     const ngtcp2_addr &remote_addr,
+                                     unsigned int ecn, const uint8_t *data,
+                                     size_t datalen, size_t gso_size,
+                                     uint64_t txtime);
+  bool send_blocked() const;
+  // set_tx_queued tells whether tx buffer of this object is
+  // referenced by the transmit queue of Server.
+  void set_tx_queued(bool queued);
+  // release_txbuf returns tx buffer to Server if nothing refers to
+  // it.
+  void release_txbuf();
+  // dcid_status registers the Stateless Reset Token |token| of the
+  // Destination Connection ID which this connection starts using to
+  // Server, or unregisters it when the connection stops using it.
+  // |token| is nullptr if the Connection ID has no token.
+  void dcid_status(int type, const uint8_t *token);
 
 private:
   struct ev_loop *loop_;
   Server *server_;
   ev_io wev_;
   ev_timer timer_;
-  FILE *qlog_;
+  // wheel_entry_ is the timer in the timer wheel of Server.  It is
+  // used instead of timer_ if --timer-wheel is given.
+  TimerWheelEntry wheel_entry_;
+  // keep_alive_entry_ is the entry in the keep-alive wheel of Server.
+  // It is used if --keep-alive is given.
+  TimerWheelEntry keep_alive_entry_;
+  QlogFile *qlog_;
+  // trace_ records the traffic of this connection if --trace-dir is
+  // given.
+  std::unique_ptr<PktTrace> trace_;
   ngtcp2_cid scid_;
   nghttp3_conn *httpconn_;
+  // proxy_rxq_ is the UDPProxy objects which have datagrams to send
+  // to client.  It must outlive streams_ which own them.
+  std::deque<UDPProxy *> proxy_rxq_;
   std::unordered_map<int64_t, std::unique_ptr<Stream>> streams_;
   // conn_closebuf_ contains a packet which contains CONNECTION_CLOSE.
   // This packet is repeatedly sent as a response to the incoming
@@ -187,10 +377,45 @@ private:
   std::unique_ptr<Buffer> conn_closebuf_;
   // nkey_update_ is the number of key update occurred.
   size_t nkey_update_;
+  // last_token_ts_ is the timestamp when NEW_TOKEN was last
+  // submitted.
+  ngtcp2_tstamp last_token_ts_;
+  // aead_ctx_pool_ recycles the AEAD contexts of 1RTT keys across key
+  // updates.
+  ngtcp2_crypto_aead_ctx_pool aead_ctx_pool_;
   bool no_gso_;
+  // half_open_ is true if this connection is counted as half-open by
+  // Server.
+  bool half_open_;
+  // start_ts_ is the time when this object is created, that is, when
+  // the first packet of the connection is received.
+  ngtcp2_tstamp start_ts_;
+  // bdp_ is the congestion window which is last reported to Server by
+  // update_bdp.
+  uint64_t bdp_;
+  // deferred_streams_ is the IDs of the streams whose requests were
+  // received in 0-RTT, and are held until the handshake completes.
+  std::vector<int64_t> deferred_streams_;
+  // reset_tokens_ is the Stateless Reset Tokens which this connection
+  // has registered to Server.  They are unregistered when this object
+  // is destroyed.
+  std::vector<std::array<uint8_t, NGTCP2_STATELESS_RESET_TOKENLEN>>
+      reset_tokens_;
+  // rxbuf_ is the receive buffer which ngtcp2_conn_read_pkts is
+  // processing.  The payload of HTTP Datagram in it is forwarded
+  // without copying.
+  struct {
+    const uint8_t *begin;
+    const uint8_t *end;
+  } rxbuf_;
 
   struct {
     bool send_blocked;
+    // queued is true if data is waiting in the transmit queue of
+    // Server.  data must not be overwritten until it is flushed.
+    bool queued;
+    // writing is true while write_streams writes packets to data.
+    bool writing;
     size_t num_blocked;
     size_t num_blocked_sent;
     // blocked field is effective only when send_blocked is true.
@@ -202,14 +427,129 @@ private:
       const uint8_t *data;
       size_t datalen;
       size_t gso_size;
+      uint64_t txtime;
     } blocked[2];
+    // data is the buffer which GSO batch is written to.  It is taken
+    // from Server only while it is in use, so that an idle
+    // connection does not hold it.
     std::unique_ptr<uint8_t[]> data;
   } tx_;
 };
 
+// TxEntry is a GSO batch of a Handler which is queued to the
+// transmit scheduler of Server.  The scheduler submits the queued
+// entries of all Handlers with sendmmsg.
+struct TxEntry {
+  Handler *handler;
+  Endpoint *endpoint;
+  Address local_addr;
+  Address remote_addr;
+  unsigned int ecn;
+  const uint8_t *data;
+  size_t datalen;
+  size_t gso_size;
+  // txtime is the earliest departure time of this batch.  It is 0 if
+  // --txtime is not given.
+  uint64_t txtime;
+  // no_gso points to Handler's flag which is set when GSO fails.
+  bool *no_gso;
+};
+
+// SendStats contains the counters of the transmit scheduler.
+struct SendStats {
+  // ncall is the number of sendmmsg calls.
+  uint64_t ncall;
+  // nmsg is the number of messages which are sent by sendmmsg.
+  uint64_t nmsg;
+  // nentry is the number of GSO batches which are queued.
+  uint64_t nentry;
+  // max_batch is the largest number of messages that are sent by a
+  // single sendmmsg call.
+  size_t max_batch;
+  // ntxbuf is the number of transmit buffers allocated for the
+  // connections.  They are recycled, so that it is the peak number
+  // of the connections which were writing, or whose packets were
+  // queued or blocked at the same time.
+  size_t ntxbuf;
+};
+
+#ifdef HAVE_LIBURING
+// UringCqe is a copy of io_uring completion which is reaped while
+// waiting for the other completions.
+struct UringCqe {
+  uint64_t user_data;
+  int32_t res;
+  uint32_t flags;
+};
+#endif // HAVE_LIBURING
+
+// FileStats contains the counters of serving files.  They are
+// useful to tune --file-extent.
+struct FileStats {
+  // nextent is the number of file extents handed to nghttp3.
+  uint64_t nextent;
+  // nbytes is the number of bytes of files handed to nghttp3.  They
+  // are read directly from the file mapping without copying.
+  uint64_t nbytes;
+  // nprefetch is the number of extents which are prefetched with
+  // MADV_WILLNEED.
+  uint64_t nprefetch;
+  // minflt and majflt are the number of minor and major page faults
+  // that the event loop thread takes.
+  uint64_t minflt;
+  uint64_t majflt;
+};
+
+// EarlyDataStats contains the counters of the requests which are
+// received in 0-RTT.
+struct EarlyDataStats {
+  // nsafe is the number of requests with a safe method which are
+  // processed immediately.
+  uint64_t nsafe;
+  // nunsafe is the number of requests with an unsafe method which
+  // are processed immediately.
+  uint64_t nunsafe;
+  // ndeferred is the number of requests which are held until the
+  // handshake completes.
+  uint64_t ndeferred;
+  // nrejected is the number of requests which are answered with 425
+  // (Too Early).
+  uint64_t nrejected;
+};
+
+// Tombstone is what remains of a connection in the closing or
+// draining period after its Handler is freed.  It answers the
+// packets of the connection with the saved CONNECTION_CLOSE until
+// expiry.
+struct Tombstone {
+  // cids is the Connection IDs which are routed to this tombstone.
+  std::vector<ngtcp2_cid> cids;
+  // closebuf is the packet which contains CONNECTION_CLOSE.  It is
+  // empty in the draining period.
+  std::vector<uint8_t> closebuf;
+  // ep, local_addr, and remote_addr are the path which closebuf is
+  // sent to.
+  Endpoint *ep;
+  Address local_addr;
+  Address remote_addr;
+  // expiry is the time when the closing or draining period ends.
+  ngtcp2_tstamp expiry;
+};
+
+// AdmissionBucket is a token bucket of new connections which are
+// accepted from an address prefix without address validation.
+struct AdmissionBucket {
+  // tokens is the number of new connections which can be accepted
+  // now.
+  size_t tokens;
+  // last_ts is the time when tokens was last replenished.
+  ngtcp2_tstamp last_ts;
+};
+
 class Server {
 public:
-  Server(struct ev_loop *loop, TLSServerContext &tls_ctx);
+  Server(struct ev_loop *loop, TLSServerContext &tls_ctx,
+         uint8_t worker_id = 0);
   ~Server();
 
   int init(const char *addr, const char *port);
@@ -217,6 +557,29 @@ public:
   void close();
 
   int on_read(Endpoint &ep);
+  int on_read_batch(Endpoint &ep);
+  void on_read_msg(Endpoint &ep, msghdr *msg, uint8_t *data, size_t datalen);
+  // on_read_dgram processes a datagram |data| of length |datalen|
+  // from |sa| whose ancillary data has already been parsed into |pi|,
+  // |local_addr|, and |gso_size|.
+  void on_read_dgram(Endpoint &ep, const sockaddr *sa, socklen_t salen,
+                     const ngtcp2_pkt_info &pi, Address local_addr,
+                     size_t gso_size, uint8_t *data, size_t datalen);
+  // prepare_rx_hp_masks precomputes header protection masks of
+  // UDP_GRO segments in |data| of length |datalen| whose segment size
+  // is |gso_size|.
+  void prepare_rx_hp_masks(const uint8_t *data, size_t datalen,
+                           size_t gso_size);
+  void read_pkt(Endpoint &ep, const Address &local_addr, const sockaddr *sa,
+                socklen_t salen, const ngtcp2_pkt_info *pi, uint8_t *data,
+                size_t datalen);
+  // read_pkts passes UDP_GRO segments in |data| of length |datalen|
+  // to a connection in a single call if all of them are short header
+  // packets destined to the same established connection.  It returns
+  // true if it has processed the segments.
+  bool read_pkts(Endpoint &ep, const Address &local_addr, const sockaddr *sa,
+                 socklen_t salen, const ngtcp2_pkt_info *pi, uint8_t *data,
+                 size_t datalen, size_t gso_size);
   int send_version_negotiation(uint32_t version, const uint8_t *dcid,
                                size_t dcidlen, const uint8_t *scid,
                                size_t scidlen, Endpoint &ep,
@@ -228,9 +591,21 @@ public:
   int send_stateless_connection_close(const ngtcp2_pkt_hd *chd, Endpoint &ep,
                                       const Address &local_addr,
                                       const sockaddr *sa, socklen_t salen);
+  // send_stateless_reset sends Stateless Reset in response to a
+  // packet of length |pktlen| whose Destination Connection ID is
+  // |dcid| of length |dcidlen|.  The number of Stateless Reset
+  // packets is rate limited.
+  int send_stateless_reset(size_t pktlen, const uint8_t *dcid,
+                           size_t dcidlen, Endpoint &ep,
+                           const Address &local_addr, const sockaddr *sa,
+                           socklen_t salen);
   int verify_retry_token(ngtcp2_cid *ocid, const ngtcp2_pkt_hd *hd,
                          const sockaddr *sa, socklen_t salen);
-  int verify_token(const ngtcp2_pkt_hd *hd, const sockaddr *sa,
+  // verify_token verifies the regular token in |hd|.  If the token
+  // carries the congestion control state, it is stored to
+  // |*cc_resume|.
+  int verify_token(ngtcp2_cc_resume_params *cc_resume,
+                   const ngtcp2_pkt_hd *hd, const sockaddr *sa,
                    socklen_t salen);
   int send_packet(Endpoint &ep, const ngtcp2_addr &local_addr,
                   const ngtcp2_addr &remote_addr, unsigned int ecn,
@@ -239,18 +614,402 @@ public:
                                      const ngtcp2_addr &local_addr,
                                      const ngtcp2_addr &remote_addr,
                                      unsigned int ecn, const uint8_t *data,
-                                     size_t datalen, size_t gso_size);
+                                     size_t datalen, size_t gso_size,
+                                     uint64_t txtime);
+  // send_packet_now sends |data| of length |datalen| to the network
+  // bypassing the emulated link.
+  std::pair<size_t, int> send_packet_now(Endpoint &ep, bool &no_gso,
+                                         const ngtcp2_addr &local_addr,
+                                         const ngtcp2_addr &remote_addr,
+                                         unsigned int ecn, const uint8_t *data,
+                                         size_t datalen, size_t gso_size,
+                                         uint64_t txtime);
+  // netem_send puts each packet in a GSO batch |data| of length
+  // |datalen| into the emulated link.
+  void netem_send(Endpoint &ep, const ngtcp2_addr &local_addr,
+                  const ngtcp2_addr &remote_addr, unsigned int ecn,
+                  const uint8_t *data, size_t datalen, size_t gso_size);
+  // update_netem_timer arms the ev_timer to the time when the next
+  // packet leaves the emulated link.
+  void update_netem_timer();
+  // on_netem sends the packets which have left the emulated link.
+  void on_netem();
   void remove(const Handler *h);
+  // add_tombstone frees |h| which has entered the closing or
+  // draining period, and keeps only what is needed to answer its
+  // packets until the period ends.
+  void add_tombstone(Handler *h);
+  // expire_tombstones removes the tombstones whose period is over.
+  void expire_tombstones();
+  // schedule_keep_alive schedules the keep-alive of |h| to the batch
+  // window in which its keep-alive timer expires.
+  void schedule_keep_alive(Handler *h);
+  void cancel_keep_alive(Handler *h);
+  // on_keep_alive pings the connections whose batch window has come.
+  void on_keep_alive();
+  // update_keep_alive_timer arms the ev_timer to the earliest expiry
+  // in the keep-alive wheel.
+  void update_keep_alive_timer();
+
+  // add_half_open and remove_half_open increment and decrement the
+  // number of half-open connections.
+  void add_half_open();
+  void remove_half_open();
+  // add_bdp adds |delta| to the aggregate bandwidth-delay product of
+  // the connections.
+  void add_bdp(int64_t delta);
+  // update_sock_buf resizes the socket buffers after the aggregate
+  // bandwidth-delay product.
+  void update_sock_buf();
+  // on_rxq_drops counts the datagrams dropped by the kernel on |ep|
+  // from the SO_RXQ_OVFL counter |drops|.
+  void on_rxq_drops(Endpoint &ep, uint32_t drops);
+#ifdef HAVE_RECVMMSG
+  // prefetch_conn starts loading the state of the connection which
+  // the datagram |ent| is destined to into cache.
+  void prefetch_conn(const ngtcp2_pkt_batch_entry &ent);
+#endif // HAVE_RECVMMSG
+  // need_retry returns true if a new connection from |sa| must
+  // validate its address with Retry before it is accepted, because
+  // there are too many half-open connections, or its address prefix
+  // exceeds config.initial_rate.
+  bool need_retry(const sockaddr *sa);
 
   void associate_cid(const ngtcp2_cid *cid, Handler *h);
   void dissociate_cid(const ngtcp2_cid *cid);
+  // associate_reset_token maps Stateless Reset Token |token| of the
+  // Connection ID which |h| uses to send packets to |h|.
+  void associate_reset_token(const uint8_t *token, Handler *h);
+  // dissociate_reset_token removes |token| if it is mapped to |h|.
+  void dissociate_reset_token(const uint8_t *token, const Handler *h);
+  // find_reset_token returns the pointer to the connection whose peer
+  // might have sent the short header packet |data| of length
+  // |datalen| as Stateless Reset, or nullptr.
+  Handler **find_reset_token(const uint8_t *data, size_t datalen);
+  // generate_cid fills |data| of length |datalen| with random bytes
+  // and encodes the worker ID into its first byte so that the eBPF
+  // program can route packets to this worker.  If
+  // config.quic_lb_server_id is not empty, it generates QUIC-LB
+  // Connection ID instead.
+  int generate_cid(uint8_t *data, size_t datalen);
+
+  // token_ctx returns the keys to generate and verify tokens.
+  ngtcp2_crypto_token_ctx *token_ctx();
+
+  // queue_packet queues |data| of length |datalen| which is a GSO
+  // batch of |h|.  The queue is flushed when it is full, or before
+  // the event loop blocks.
+  void queue_packet(Handler *h, bool &no_gso, Endpoint &ep,
+                    const ngtcp2_addr &local_addr,
+                    const ngtcp2_addr &remote_addr, unsigned int ecn,
+                    const uint8_t *data, size_t datalen, size_t gso_size,
+                    uint64_t txtime);
+  void flush_tx();
+  // acquire_txbuf returns the buffer which a connection writes GSO
+  // batch to.  The buffer is tx_bufsize bytes long.
+  std::unique_ptr<uint8_t[]> acquire_txbuf();
+  // release_txbuf puts |buf| obtained by acquire_txbuf back to the
+  // pool.
+  void release_txbuf(std::unique_ptr<uint8_t[]> buf);
+  // queue_proxy_tx adds |proxy| to the list of UDPProxy objects whose
+  // queued datagrams are flushed by flush_proxy_tx.
+  void queue_proxy_tx(UDPProxy *proxy);
+  void remove_proxy_tx(UDPProxy *proxy);
+  // flush_proxy_tx sends the datagrams queued to UDPProxy objects.  It
+  // must be called before the receive buffer is reused because they
+  // point into it.
+  void flush_proxy_tx();
+  // schedule_timer schedules |e| to expire at |expiry| in the timer
+  // wheel.
+  void schedule_timer(TimerWheelEntry *e, ngtcp2_tstamp expiry);
+  void cancel_timer(TimerWheelEntry *e);
+  // update_wheel_timer arms the ev_timer to the earliest expiry in
+  // the timer wheel.  It is called before the event loop blocks.
+  void update_wheel_timer();
+  // on_timer_wheel handles the expired entries of the timer wheel.
+  void on_timer_wheel();
+#ifdef HAVE_LIBURING
+  void on_uring_read();
+#endif // HAVE_LIBURING
+#ifdef HAVE_LIBBPF
+  // on_xdp_read processes the datagrams received by the AF_XDP
+  // socket.
+  void on_xdp_read();
+#endif // HAVE_LIBBPF
+#ifdef HAVE_LIBDPDK
+  // on_dpdk_poll polls the DPDK queue of this worker, and processes
+  // the received datagrams.
+  void on_dpdk_poll();
+#endif // HAVE_LIBDPDK
+
+  const RecvStats &recv_stats() const;
+  const SendStats &send_stats() const;
+  FileStats &file_stats();
+  EarlyDataStats &early_data_stats();
+  WorkerMetrics &metrics();
+  // transport_params_template returns the encoded transport
+  // parameters shared by the connections of this server.  Its
+  // datalen is 0 until the first connection initializes it.
+  ngtcp2_transport_params_template &transport_params_template();
+  // http_date returns the value of date header field for the current
+  // time of the event loop.
+  const std::string &http_date();
+  const std::vector<Endpoint> &endpoints() const;
+  // preferred_ipv4_addr and preferred_ipv6_addr return the preferred
+  // addresses that this server advertises.  The length of address is
+  // 0 if it is not advertised.
+  const Address &preferred_ipv4_addr() const;
+  const Address &preferred_ipv6_addr() const;
 
 private:
-  std::unordered_map<std::string, Handler *> handlers_;
+  // send_tx_entries sends tx_.entries in range [first, last) which
+  // share the same Endpoint and ECN.
+  void send_tx_entries(size_t first, size_t last);
+#ifdef HAVE_SENDMMSG
+  // block_tx_entries moves tx_.entries in range [i, last) to the send
+  // blocked state of their Handlers.  The first |offset| bytes of the
+  // entry i have been sent.
+  void block_tx_entries(Endpoint &ep, size_t i, size_t offset, size_t last);
+  // send_tx_msgs sends tx_.msgs from the index |k| with sendmmsg.
+  void send_tx_msgs(Endpoint &ep, size_t last, size_t k);
+  void on_tx_msgs_sent(size_t k, size_t n);
+#  ifdef HAVE_LIBURING
+  // uring_send_tx_msgs submits tx_.msgs as a linked chain of sendmsg
+  // and waits for their completion.
+  void uring_send_tx_msgs(Endpoint &ep, size_t last);
+#  endif // HAVE_LIBURING
+#endif // HAVE_SENDMMSG
+#ifdef HAVE_LIBURING
+  int uring_init();
+  void uring_free();
+  // uring_arm_recv queues multishot recvmsg for endpoints_[epidx].
+  void uring_arm_recv(size_t epidx);
+  void uring_handle_cqe(uint64_t user_data, int32_t res, uint32_t flags);
+#endif // HAVE_LIBURING
+#ifdef HAVE_LIBBPF
+  // xdp_init creates AF_XDP socket bound to the receive queue of this
+  // worker.
+  int xdp_init(const XdpProgram &prog);
+#endif // HAVE_LIBBPF
+#ifdef HAVE_LIBDPDK
+  // dpdk_init starts polling the queue pair of |port| for this
+  // worker.
+  int dpdk_init(const DpdkPort &port);
+#endif // HAVE_LIBDPDK
+  // read_frame passes UDP datagram |data| received by AF_XDP or DPDK
+  // datapath to the connection.
+  void read_frame(const xdp::FrameInfo &fi, uint8_t *data);
+
+  CIDMap<Handler *> handlers_;
+  // reset_tokens_ maps the Stateless Reset Tokens of the Destination
+  // Connection IDs in use to the connections, so that a Stateless
+  // Reset whose Connection ID is random is found with a single
+  // lookup.  A token fits in ngtcp2_cid, and CIDMap is reused.
+  CIDMap<Handler *> reset_tokens_;
   struct ev_loop *loop_;
   std::vector<Endpoint> endpoints_;
   TLSServerContext &tls_ctx_;
   ev_signal sigintev_;
+  RecvStats rx_stats_;
+  SendStats tx_stats_;
+  FileStats file_stats_;
+  EarlyDataStats early_data_stats_;
+  // metrics_ is owned by the MetricsRegistry shared by all workers.
+  WorkerMetrics *metrics_;
+  ngtcp2_transport_params_template tp_template_;
+  util::HTTPDateCache date_cache_;
+  // proxy_txq_ is the UDPProxy objects which have queued datagrams
+  // to send to the targets.
+  std::vector<UDPProxy *> proxy_txq_;
+  // worker_id_ is the index of the worker which runs this server.
+  uint8_t worker_id_;
+  // preferred_ipv4_addr_ and preferred_ipv6_addr_ are the preferred
+  // addresses of this server.
+  Address preferred_ipv4_addr_;
+  Address preferred_ipv6_addr_;
+  // initial_key_cache_ keeps the Initial keys which
+  // send_stateless_connection_close derived, so that the
+  // retransmitted Initial packets from the same client do not run
+  // the key derivation again.
+  ngtcp2_crypto_initial_key_cache initial_key_cache_;
+  // token_ctx_ holds the keys for Retry and regular tokens which are
+  // derived from config.static_secret once.
+  ngtcp2_crypto_token_ctx token_ctx_;
+  // retry_ctx_ holds the AEAD contexts which compute Retry Integrity
+  // Tag, so that send_retry does not create them for each packet.
+  ngtcp2_crypto_retry_ctx retry_ctx_;
+  // vn_sv_ is the supported versions sent in Version Negotiation
+  // packet.  The first element is a reserved version which is
+  // computed per packet, and the rest is filled once in init.
+  std::array<uint32_t, 1 + max_preferred_versionslen> vn_sv_;
+  // vn_svlen_ is the number of elements of vn_sv_ in use.
+  size_t vn_svlen_;
+  // lb_cid_ctx_ holds the key to encrypt QUIC-LB Connection IDs.  It
+  // is initialized if config.quic_lb_key is not empty.
+  ngtcp2_crypto_cid_ctx lb_cid_ctx_;
+  // lb_config_ is the QUIC-LB configuration.  It is used if
+  // config.quic_lb_server_id is not empty.
+  ngtcp2_crypto_quic_lb_config lb_config_;
+
+  struct {
+    // budget is the number of Stateless Reset packets which can be
+    // sent now.
+    size_t budget;
+    // last_ts is the time when budget was last replenished.
+    ngtcp2_tstamp last_ts;
+  } stateless_reset_;
+
+  struct {
+    // half_open is the number of connections which have not completed
+    // the handshake.
+    size_t half_open;
+    // seed randomizes the mapping from an address prefix to a bucket
+    // so that a client cannot choose the bucket of the other.
+    uint32_t seed;
+    // buckets are the token buckets of new connections per address
+    // prefix.  The address prefixes which hash to the same bucket
+    // share it.
+    std::array<AdmissionBucket, 4096> buckets;
+  } admission_;
+
+  struct {
+    // data is the buffer which receives config.recv_batch datagrams.
+    // It is allocated only if config.recv_batch > 1.
+    std::unique_ptr<uint8_t[]> data;
+#ifdef HAVE_RECVMMSG
+    std::vector<mmsghdr> msgs;
+    std::vector<iovec> iovs;
+    std::vector<sockaddr_union> addrs;
+    std::vector<uint8_t> ctrl;
+    // info is the ancillary data of the last batch.
+    RecvBatchInfo info;
+    // dgrams points to the datagrams of the last batch.
+    std::vector<ngtcp2_vec> dgrams;
+    // ents is the datagrams of the last batch grouped by connection.
+    std::vector<ngtcp2_pkt_batch_entry> ents;
+#endif // HAVE_RECVMMSG
+  } rx_;
+
+  struct {
+    // entries is the queue of GSO batches which are waiting for
+    // sendmmsg.
+    std::vector<TxEntry> entries;
+    // bufs is the pool of the transmit buffers which are not used by
+    // any connection.
+    std::vector<std::unique_ptr<uint8_t[]>> bufs;
+#ifdef HAVE_SENDMMSG
+    std::vector<mmsghdr> msgs;
+    std::vector<iovec> iovs;
+    std::vector<uint8_t> ctrl;
+    // msgent is the index of TxEntry and the offset in it for each
+    // message in msgs.
+    std::vector<std::pair<size_t, size_t>> msgent;
+#  ifdef HAVE_LIBURING
+    // uring_res is the result of sendmsg for each message in msgs.
+    std::vector<int32_t> uring_res;
+#  endif // HAVE_LIBURING
+#endif // HAVE_SENDMMSG
+    ev_prepare prep;
+  } tx_;
+
+  struct {
+    // wheel schedules the timers of all Handlers if --timer-wheel is
+    // given.
+    TimerWheel wheel;
+    // timer is armed to the earliest expiry in wheel.
+    ev_timer timer;
+    ev_prepare prep;
+    // armed is the expiry which timer is armed to, or UINT64_MAX.
+    ngtcp2_tstamp armed;
+  } timers_;
+
+  struct {
+    // timer periodically resizes the socket buffers if
+    // --sock-buf-max is given.
+    ev_timer timer;
+    // bdp is the sum of the congestion windows of the connections.
+    uint64_t bdp;
+    // min is the size of the socket buffers that the kernel
+    // initially gives.  The buffers are never shrunk below it.
+    uint64_t min;
+    // size is the current size of the socket buffers.
+    uint64_t size;
+  } sock_buf_;
+
+  struct {
+    // entries is the tombstones in the order of creation.  Because
+    // the period is 3 times PTO which rarely changes much between
+    // connections, it is roughly the order of expiry as well.  A
+    // tombstone may outlive its expiry until the ones before it
+    // expire, which RFC 9000 permits as the period is "at least" 3
+    // times PTO.
+    std::deque<Tombstone> entries;
+    // cids maps the Connection IDs to the tombstones in entries.
+    CIDMap<Tombstone *> cids;
+    // timer is armed to the expiry of the first entry.
+    ev_timer timer;
+  } tombstones_;
+
+  struct {
+    // wheel schedules the keep-alive of the connections if
+    // --keep-alive is given.  The expiry is rounded down to the
+    // multiple of window, so that the connections which expire in the
+    // same window are pinged in a single batch.
+    TimerWheel wheel;
+    // window is the granularity of a level of wheel.
+    ngtcp2_duration window;
+    // timer is armed to the earliest expiry in wheel.
+    ev_timer timer;
+    // armed is the expiry which timer is armed to, or UINT64_MAX.
+    ngtcp2_tstamp armed;
+  } keep_alive_;
+
+  struct {
+    // link emulates the network link which the outgoing packets go
+    // through if --netem is given.
+    std::unique_ptr<NetEm> link;
+    // timer is armed to the time when the next packet leaves link.
+    ev_timer timer;
+  } netem_;
+
+#ifdef HAVE_LIBURING
+  struct {
+    io_uring ring;
+    bool initialized;
+    io_uring_buf_ring *br;
+    // bufs is the memory which backs the provided buffer ring.
+    std::unique_ptr<uint8_t[]> bufs;
+    size_t bufsize;
+    // msg is the template for multishot recvmsg.
+    msghdr msg;
+    // efd is eventfd which is signaled when a completion is posted.
+    int efd;
+    ev_io rev;
+    // cqes is the receive completions which are reaped while waiting
+    // for send completions.
+    std::vector<UringCqe> cqes;
+  } uring_;
+#endif // HAVE_LIBURING
+
+#ifdef HAVE_LIBBPF
+  struct {
+    // sock is the AF_XDP socket if --xdp is given.  All datagrams of
+    // this worker are sent through it.
+    std::unique_ptr<XdpSocket> sock;
+    ev_io rev;
+  } xdp_;
+#endif // HAVE_LIBBPF
+
+#ifdef HAVE_LIBDPDK
+  struct {
+    // queue is the queue pair of this worker if --dpdk is given.  All
+    // datagrams of this worker are sent through it.
+    std::unique_ptr<DpdkQueue> queue;
+    // idle polls queue whenever the event loop has nothing else to
+    // do, which keeps the loop from blocking.
+    ev_idle idle;
+  } dpdk_;
+#endif // HAVE_LIBDPDK
 };
 
 #endif // SERVER_H
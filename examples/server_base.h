@@ -35,15 +35,32 @@
 #include <string>
 #include <string_view>
 #include <functional>
+#include <optional>
 
 #include <ngtcp2/ngtcp2_crypto.h>
 
 #include "tls_server_session.h"
 #include "network.h"
 #include "shared.h"
+#include "event_loop.h"
+#include "netem.h"
 
 using namespace ngtcp2;
 
+// EarlyRequestPolicy tells how server handles a request which is
+// received in 0-RTT before the handshake completes, and whose method
+// is not safe.  0-RTT can be replayed by an attacker.
+enum class EarlyRequestPolicy {
+  // ACCEPT processes the request immediately.
+  ACCEPT,
+  // DEFER holds the request until the handshake completes, which
+  // proves that the request is not replayed.
+  DEFER,
+  // REJECT answers the request with 425 (Too Early) so that client
+  // retries it after the handshake.
+  REJECT,
+};
+
 struct Config {
   Address preferred_ipv4_addr;
   Address preferred_ipv6_addr;
@@ -51,6 +68,9 @@ struct Config {
   double tx_loss_prob;
   // rx_loss_prob is probability of losing incoming packet.
   double rx_loss_prob;
+  // netem is the configuration of the emulated network link which
+  // outgoing packets go through.
+  std::optional<NetEmConfig> netem;
   // ciphers is the list of enabled ciphers.
   const char *ciphers;
   // groups is the list of supported groups.
@@ -85,6 +105,16 @@ struct Config {
   bool verify_client;
   // qlog_dir is the path to directory where qlog is stored.
   std::string_view qlog_dir;
+  // qlog_binary is true if qlog is written in the binary format.
+  bool qlog_binary;
+  // qlog_compress is true if qlog files are gzip compressed.
+  bool qlog_compress;
+  // qlog_ring_size, if nonzero, is the size of the ring file which
+  // each worker writes qlog into.
+  size_t qlog_ring_size;
+  // trace_dir is the path to directory where the packet traces are
+  // stored.
+  std::string_view trace_dir;
   // no_quic_dump is true if hexdump of QUIC STREAM and CRYPTO data
   // should be disabled.
   bool no_quic_dump;
@@ -147,9 +177,137 @@ struct Config {
   std::vector<uint32_t> other_versions;
   // no_pmtud disables Path MTU Discovery.
   bool no_pmtud;
+  // pmtud_search makes Path MTU Discovery bisect UDP payload size up
+  // to max_udp_payload_size.
+  bool pmtud_search;
+  // spin_bit enables the latency spin bit.
+  bool spin_bit;
+  // pto_probe_policy is the policy which decides what a PTO probe
+  // packet carries.
+  ngtcp2_pto_probe_policy pto_probe_policy;
   // ack_thresh is the maximum number of unacknowledged packets before sending
   // acknowledgement. It triggers the immediate acknowledgement.
   size_t ack_thresh;
+  // recv_batch is the maximum number of UDP datagrams that are
+  // received in a single recvmmsg call.  If it is 1, recvmsg is used
+  // instead.
+  size_t recv_batch;
+  // gro is true if UDP_GRO is enabled so that the kernel coalesces
+  // incoming datagrams into a single buffer.
+  bool gro;
+  // send_batch is the maximum number of GSO batches from all
+  // connections which are submitted in a single sendmmsg call.  If it
+  // is 1, each batch is sent by sendmsg immediately.
+  size_t send_batch;
+  // txtime is the pacing horizon.  If it is nonzero, SO_TXTIME is
+  // enabled, and each GSO batch carries its earliest departure time
+  // so that fq qdisc paces packets in the kernel.  ngtcp2 is allowed
+  // to write packets up to this duration ahead of their send time.
+  ngtcp2_duration txtime;
+  // timer_wheel is true if the timers of all connections are managed
+  // by a timer wheel instead of an ev_timer per connection.
+  bool timer_wheel;
+  // io_uring is true if io_uring is used to receive and send UDP
+  // datagrams instead of recvmsg and sendmmsg.
+  bool io_uring;
+  // workers is the number of worker threads.  Each worker has its own
+  // event loop and UDP sockets bound with SO_REUSEPORT.
+  size_t workers;
+  // worker_cpus is the CPUs which the workers are pinned to.  The
+  // worker i runs on worker_cpus[i], and its sockets prefer the
+  // packets processed on that CPU.  The workers are not pinned if it
+  // is empty.
+  std::vector<uint32_t> worker_cpus;
+  // busy_poll is the duration in microseconds that a read on the
+  // sockets busy polls the device queue.  0 disables busy polling.
+  uint32_t busy_poll;
+  // sock_buf_max is the upper bound of the socket buffer size which
+  // follows the aggregate bandwidth-delay product of the connections.
+  // 0 leaves the size to the kernel.
+  size_t sock_buf_max;
+  // bpf_program is the path to the eBPF object file which steers
+  // incoming packets to the worker that owns the Connection ID.
+  std::string_view bpf_program;
+  // xdp_ifname is the network interface which QUIC packets are
+  // received from and sent to with AF_XDP.  AF_XDP is not used if it
+  // is empty.
+  std::string_view xdp_ifname;
+  // xdp_program is the path to the XDP object file which redirects
+  // QUIC packets to the AF_XDP sockets.
+  std::string_view xdp_program;
+  // xdp_queue is the receive queue which the first worker binds its
+  // AF_XDP socket to.  The worker i binds to xdp_queue + i.
+  uint32_t xdp_queue;
+  // dpdk is true if QUIC packets are received from and sent to
+  // dpdk_port_id with DPDK.
+  bool dpdk;
+  // dpdk_port_id is the DPDK port ID of the Ethernet device.
+  uint16_t dpdk_port_id;
+  // dpdk_eal_args is the whitespace separated arguments passed to
+  // DPDK EAL.
+  std::string_view dpdk_eal_args;
+  // anti_replay is true if a replayed 0-RTT ClientHello is detected
+  // by a filter shared by all workers, and its early data is
+  // rejected.
+  bool anti_replay;
+  // file_extent is the number of bytes of a served file which are
+  // handed to nghttp3 at a time.  If it is nonzero, files are mapped
+  // with MADV_SEQUENTIAL, and the next extent is prefetched with
+  // MADV_WILLNEED while the current one is sent.  If it is 0, the
+  // whole file is handed out at once.
+  size_t file_extent;
+  // file_cache_size is the maximum total length of files which are
+  // kept mapped in the cache shared by all workers.
+  uint64_t file_cache_size;
+  // dyn_pattern is true if the body of a dynamic response is taken
+  // from a precomputed pseudo random pattern, and its checksum is
+  // sent in x-ngtcp2-checksum trailer field.
+  bool dyn_pattern;
+  // quic_lb_server_id, if not empty, is the QUIC-LB server ID which
+  // is encoded in every Connection ID that server issues, so that a
+  // load balancer routes packets to this server without keeping
+  // state.
+  std::string quic_lb_server_id;
+  // quic_lb_config_id is the QUIC-LB config rotation ID.
+  uint8_t quic_lb_config_id;
+  // quic_lb_key, if not empty, is the secret shared with the load
+  // balancers.  Server ID and nonce in Connection ID are encrypted
+  // with the key derived from it.
+  std::string_view quic_lb_key;
+  // retry_half_open, if nonzero, is the number of half-open
+  // connections at or above which server sends Retry to a client
+  // which has not validated its address.
+  size_t retry_half_open;
+  // initial_rate, if nonzero, is the number of new connections per
+  // second that server accepts from an address prefix without
+  // address validation.  The excess is answered with Retry.
+  size_t initial_rate;
+  // fast_nat_rebinding is true if the new path is treated as
+  // validated on NAT rebinding.
+  bool fast_nat_rebinding;
+  // preferred_addr_per_worker is true if each worker advertises its
+  // own preferred address whose port is the port of
+  // preferred_ipv4_addr or preferred_ipv6_addr plus the worker ID.
+  bool preferred_addr_per_worker;
+  // unsafe_early_request is how a request with an unsafe method which
+  // is received in 0-RTT is handled.
+  EarlyRequestPolicy unsafe_early_request;
+  // metrics_addr, if its length is nonzero, is the TCP address where
+  // the metrics of all workers are served in Prometheus text format.
+  Address metrics_addr;
+  // event_loop selects the backend of the event loops.
+  EventLoopConfig event_loop;
+  // bench_size, if nonzero, is the length of the synthetic response
+  // body which h09server returns to every request instead of a file.
+  uint64_t bench_size;
+  // keep_alive_timeout, if nonzero, is the keep-alive timeout of each
+  // connection.  The keep-alive of all connections of a worker is
+  // scheduled in batch windows by Server.
+  ngtcp2_duration keep_alive_timeout;
+  // connect_udp is true if server accepts CONNECT-UDP requests
+  // (RFC 9298), and proxies HTTP Datagrams to the requested UDP
+  // targets.
+  bool connect_udp;
 };
 
 struct Buffer {
@@ -28,9 +28,12 @@
 
 #include <cstring>
 #include <cassert>
+#include <algorithm>
 #include <iostream>
 
 #include <unistd.h>
+#include <sys/resource.h>
+#include <netinet/udp.h>
 #ifdef HAVE_NETINET_IN_H
 #  include <netinet/in.h>
 #endif // HAVE_NETINET_IN_H
@@ -43,11 +46,91 @@
 #ifdef HAVE_LINUX_RTNETLINK_H
 #  include <linux/rtnetlink.h>
 #endif // HAVE_LINUX_RTNETLINK_H
+#ifdef SO_TXTIME
+#  include <linux/net_tstamp.h>
+#endif // SO_TXTIME
 
 #include "template.h"
+#include "util.h"
 
 namespace ngtcp2 {
 
+void bench_stats_on_body(BenchStats &st, size_t len, ngtcp2_tstamp ts) {
+  if (len == 0) {
+    return;
+  }
+
+  if (st.nbody_bytes == 0) {
+    st.first_ts = ts;
+  }
+
+  st.nbody_bytes += len;
+  st.last_ts = ts;
+}
+
+void add_bench_stats(BenchStats &dest, const BenchStats &src) {
+  dest.nsend_call += src.nsend_call;
+  dest.nsend_pkt += src.nsend_pkt;
+  dest.nsend_bytes += src.nsend_bytes;
+  dest.nrecv_call += src.nrecv_call;
+  dest.nrecv_pkt += src.nrecv_pkt;
+  dest.nrecv_bytes += src.nrecv_bytes;
+
+  if (src.nbody_bytes == 0) {
+    return;
+  }
+
+  if (dest.nbody_bytes == 0) {
+    dest.first_ts = src.first_ts;
+    dest.last_ts = src.last_ts;
+  } else {
+    dest.first_ts = std::min(dest.first_ts, src.first_ts);
+    dest.last_ts = std::max(dest.last_ts, src.last_ts);
+  }
+
+  dest.nbody_bytes += src.nbody_bytes;
+}
+
+namespace {
+double ratio(uint64_t n, uint64_t d) {
+  return d ? static_cast<double>(n) / static_cast<double>(d) : 0.;
+}
+} // namespace
+
+void print_bench_stats(const BenchStats &st, uint64_t cpu) {
+  auto elapsed = st.last_ts - st.first_ts;
+  auto secs = static_cast<double>(elapsed) / NGTCP2_SECONDS;
+  auto mbps =
+      secs > 0 ? static_cast<double>(st.nbody_bytes) * 8 / secs / 1'000'000
+               : 0.;
+
+  std::cerr << "Bench stats: bytes=" << st.nbody_bytes
+            << " elapsed=" << util::format_durationf(elapsed)
+            << " goodput=" << mbps << "Mbps"
+            << " cpu=" << util::format_durationf(cpu)
+            << " cpu_usage=" << ratio(cpu * 100, elapsed) << "%"
+            << " tx_pkts_per_call=" << ratio(st.nsend_pkt, st.nsend_call)
+            << " tx_bytes_per_pkt=" << ratio(st.nsend_bytes, st.nsend_pkt)
+            << " rx_pkts_per_call=" << ratio(st.nrecv_pkt, st.nrecv_call)
+            << " rx_bytes_per_pkt=" << ratio(st.nrecv_bytes, st.nrecv_pkt)
+            << std::endl;
+}
+
+uint64_t process_cpu_time() {
+  rusage ru;
+
+  if (getrusage(RUSAGE_SELF, &ru) != 0) {
+    return 0;
+  }
+
+  auto tv_nsec = [](const timeval &tv) {
+    return static_cast<uint64_t>(tv.tv_sec) * NGTCP2_SECONDS +
+           static_cast<uint64_t>(tv.tv_usec) * NGTCP2_MICROSECONDS;
+  };
+
+  return tv_nsec(ru.ru_utime) + tv_nsec(ru.ru_stime);
+}
+
 unsigned int msghdr_get_ecn(msghdr *msg, int family) {
   switch (family) {
   case AF_INET:
@@ -187,6 +270,231 @@ std::optional<Address> msghdr_get_local_addr(msghdr *msg, int family) {
   return {};
 }
 
+int fd_set_udp_gro(int fd) {
+#ifdef UDP_GRO
+  int val = 1;
+
+  if (setsockopt(fd, IPPROTO_UDP, UDP_GRO, &val,
+                 static_cast<socklen_t>(sizeof(val))) == -1) {
+    std::cerr << "setsockopt: UDP_GRO: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  return 0;
+#else  // !defined(UDP_GRO)
+  std::cerr << "setsockopt: UDP_GRO is not supported" << std::endl;
+  return -1;
+#endif // !defined(UDP_GRO)
+}
+
+int fd_set_txtime(int fd) {
+#ifdef SO_TXTIME
+  // ngtcp2 timestamps come from the monotonic clock, and fq qdisc
+  // expects the departure time in CLOCK_MONOTONIC.
+  sock_txtime val{
+      .clockid = CLOCK_MONOTONIC,
+      .flags = 0,
+  };
+
+  if (setsockopt(fd, SOL_SOCKET, SO_TXTIME, &val,
+                 static_cast<socklen_t>(sizeof(val))) == -1) {
+    std::cerr << "setsockopt: SO_TXTIME: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  return 0;
+#else  // !defined(SO_TXTIME)
+  std::cerr << "setsockopt: SO_TXTIME is not supported" << std::endl;
+  return -1;
+#endif // !defined(SO_TXTIME)
+}
+
+int fd_set_incoming_cpu(int fd, int cpu) {
+#ifdef SO_INCOMING_CPU
+  if (setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu,
+                 static_cast<socklen_t>(sizeof(cpu))) == -1) {
+    std::cerr << "setsockopt: SO_INCOMING_CPU: " << strerror(errno)
+              << std::endl;
+    return -1;
+  }
+
+  return 0;
+#else  // !defined(SO_INCOMING_CPU)
+  std::cerr << "setsockopt: SO_INCOMING_CPU is not supported" << std::endl;
+  return -1;
+#endif // !defined(SO_INCOMING_CPU)
+}
+
+int fd_set_busy_poll(int fd, int usec) {
+#ifdef SO_BUSY_POLL
+  // Raising the value above net.core.busy_read requires
+  // CAP_NET_ADMIN.
+  if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec,
+                 static_cast<socklen_t>(sizeof(usec))) == -1) {
+    std::cerr << "setsockopt: SO_BUSY_POLL: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  return 0;
+#else  // !defined(SO_BUSY_POLL)
+  std::cerr << "setsockopt: SO_BUSY_POLL is not supported" << std::endl;
+  return -1;
+#endif // !defined(SO_BUSY_POLL)
+}
+
+void fd_set_rxq_ovfl(int fd) {
+#ifdef SO_RXQ_OVFL
+  int val = 1;
+
+  if (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &val,
+                 static_cast<socklen_t>(sizeof(val))) == -1) {
+    std::cerr << "setsockopt: SO_RXQ_OVFL: " << strerror(errno) << std::endl;
+  }
+#endif // SO_RXQ_OVFL
+}
+
+int fd_set_sock_bufsize(int fd, int size) {
+  if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size,
+                 static_cast<socklen_t>(sizeof(size))) == -1) {
+    std::cerr << "setsockopt: SO_RCVBUF: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  if (setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size,
+                 static_cast<socklen_t>(sizeof(size))) == -1) {
+    std::cerr << "setsockopt: SO_SNDBUF: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int fd_get_rcvbuf(int fd) {
+  int val;
+  auto len = static_cast<socklen_t>(sizeof(val));
+
+  if (getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &val, &len) == -1) {
+    return -1;
+  }
+
+#ifdef __linux__
+  // Linux doubles the value to account for the bookkeeping overhead,
+  // and returns the doubled value.
+  return val / 2;
+#else  // !defined(__linux__)
+  return val;
+#endif // !defined(__linux__)
+}
+
+size_t msghdr_get_udp_gro(msghdr *msg) {
+#ifdef UDP_GRO
+  for (auto cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+      int gso_size;
+      memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+      return static_cast<size_t>(gso_size);
+    }
+  }
+#endif // UDP_GRO
+
+  return 0;
+}
+
+namespace {
+void parse_recv_cmsgs(unsigned int &ecn, Address &local_addr,
+                      size_t &gso_size, uint32_t &drops, msghdr *msg) {
+  ecn = 0;
+  local_addr.len = 0;
+  gso_size = 0;
+  drops = 0;
+
+  for (auto cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    switch (cmsg->cmsg_level) {
+#ifdef SO_RXQ_OVFL
+    case SOL_SOCKET:
+      if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+        memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+      }
+      break;
+#endif // SO_RXQ_OVFL
+    case IPPROTO_IP:
+      switch (cmsg->cmsg_type) {
+      case IP_TOS:
+        if (cmsg->cmsg_len) {
+          ecn = *reinterpret_cast<uint8_t *>(CMSG_DATA(cmsg));
+        }
+        break;
+      case IP_PKTINFO: {
+        auto pktinfo = reinterpret_cast<in_pktinfo *>(CMSG_DATA(cmsg));
+        local_addr = Address{};
+        local_addr.ifindex = pktinfo->ipi_ifindex;
+        local_addr.len = sizeof(local_addr.su.in);
+        auto &sa = local_addr.su.in;
+        sa.sin_family = AF_INET;
+        sa.sin_addr = pktinfo->ipi_addr;
+        break;
+      }
+      }
+      break;
+    case IPPROTO_IPV6:
+      switch (cmsg->cmsg_type) {
+      case IPV6_TCLASS:
+        if (cmsg->cmsg_len) {
+          ecn = *reinterpret_cast<uint8_t *>(CMSG_DATA(cmsg));
+        }
+        break;
+      case IPV6_PKTINFO: {
+        auto pktinfo = reinterpret_cast<in6_pktinfo *>(CMSG_DATA(cmsg));
+        local_addr = Address{};
+        local_addr.ifindex = pktinfo->ipi6_ifindex;
+        local_addr.len = sizeof(local_addr.su.in6);
+        auto &sa = local_addr.su.in6;
+        sa.sin6_family = AF_INET6;
+        sa.sin6_addr = pktinfo->ipi6_addr;
+        break;
+      }
+      }
+      break;
+#ifdef UDP_GRO
+    case SOL_UDP:
+      if (cmsg->cmsg_type == UDP_GRO) {
+        int n;
+        memcpy(&n, CMSG_DATA(cmsg), sizeof(n));
+        gso_size = static_cast<size_t>(n);
+      }
+      break;
+#endif // UDP_GRO
+    }
+  }
+}
+} // namespace
+
+void msghdr_get_recv_info(RecvInfo &ri, msghdr *msg) {
+  parse_recv_cmsgs(ri.ecn, ri.local_addr, ri.gso_size, ri.drops, msg);
+}
+
+#ifdef HAVE_RECVMMSG
+void RecvBatchInfo::resize(size_t n) {
+  pi.resize(n);
+  local_addr.resize(n);
+  gso_size.resize(n);
+  drops.resize(n);
+}
+
+void mmsghdr_get_recv_info(RecvBatchInfo &info, mmsghdr *msgs, size_t nmsg) {
+  assert(info.pi.size() >= nmsg);
+
+  for (size_t i = 0; i < nmsg; ++i) {
+    ngtcp2_pkt_info pi{};
+
+    parse_recv_cmsgs(pi.ecn, info.local_addr[i], info.gso_size[i],
+                     info.drops[i], &msgs[i].msg_hdr);
+
+    info.pi[i] = pi;
+  }
+}
+#endif // HAVE_RECVMMSG
+
 void set_port(Address &dst, Address &src) {
   switch (dst.su.storage.ss_family) {
   case AF_INET:
@@ -30,6 +30,7 @@
 #endif // HAVE_CONFIG_H
 
 #include <optional>
+#include <vector>
 
 #include <ngtcp2/ngtcp2.h>
 
@@ -62,6 +63,69 @@ constexpr uint32_t QUIC_VER_DRAFT30 = 0xff00001eu;
 constexpr uint32_t QUIC_VER_DRAFT31 = 0xff00001fu;
 constexpr uint32_t QUIC_VER_DRAFT32 = 0xff000020u;
 
+// RecvStats contains the counters of the receive path.  They are
+// useful to tune --recv-batch.
+struct RecvStats {
+  // ncall is the number of recvmsg or recvmmsg calls which returned
+  // at least one datagram.
+  uint64_t ncall;
+  // nfull is the number of recvmmsg calls which filled the entire
+  // batch.
+  uint64_t nfull;
+  // ndgram is the number of UDP datagrams received.
+  uint64_t ndgram;
+  // nseg is the number of QUIC packets that are passed to the
+  // connection after UDP_GRO coalesced datagrams are split.
+  uint64_t nseg;
+  // max_batch is the largest number of datagrams that are returned
+  // by a single recvmmsg call.
+  size_t max_batch;
+  // ndrop is the number of datagrams that the kernel dropped because
+  // the receive buffer of the socket was full.  It is taken from
+  // SO_RXQ_OVFL.
+  uint64_t ndrop;
+};
+
+// BenchStats is the statistics of a benchmark run of h09server and
+// h09client.
+struct BenchStats {
+  // nsend_call, nsend_pkt, and nsend_bytes are the number of sendmsg
+  // calls, and UDP datagrams and bytes sent by them.
+  uint64_t nsend_call;
+  uint64_t nsend_pkt;
+  uint64_t nsend_bytes;
+  // nrecv_call, nrecv_pkt, and nrecv_bytes are the number of recvmsg
+  // calls which returned a datagram, and UDP datagrams and bytes
+  // received by them.
+  uint64_t nrecv_call;
+  uint64_t nrecv_pkt;
+  uint64_t nrecv_bytes;
+  // nbody_bytes is the number of bytes of response bodies which are
+  // sent or received.
+  uint64_t nbody_bytes;
+  // first_ts and last_ts are the timestamps when the first and the
+  // last byte of response bodies were sent or received.
+  ngtcp2_tstamp first_ts;
+  ngtcp2_tstamp last_ts;
+};
+
+// bench_stats_on_body counts |len| bytes of response bodies which are
+// sent or received at |ts|.
+void bench_stats_on_body(BenchStats &st, size_t len, ngtcp2_tstamp ts);
+
+// add_bench_stats adds |src| to |dest|.
+void add_bench_stats(BenchStats &dest, const BenchStats &src);
+
+// print_bench_stats prints the goodput of the response bodies, the
+// CPU usage during the transfer, the number of datagrams per syscall,
+// and the bytes per datagram in |st|.  |cpu| is the CPU time in
+// nanoseconds that the process spent.
+void print_bench_stats(const BenchStats &st, uint64_t cpu);
+
+// process_cpu_time returns the user and system CPU time in
+// nanoseconds that this process has spent so far.
+uint64_t process_cpu_time();
+
 // msghdr_get_ecn gets ECN bits from |msg|.  |family| is the address
 // family from which packet is received.
 unsigned int msghdr_get_ecn(msghdr *msg, int family);
@@ -83,6 +147,93 @@ void fd_set_ip_dontfrag(int fd, int family);
 
 std::optional<Address> msghdr_get_local_addr(msghdr *msg, int family);
 
+// fd_set_udp_gro enables UDP_GRO socket option to |fd| so that
+// consecutive datagrams from the same flow are coalesced into a
+// single buffer.  It returns 0 if it succeeds, or -1.
+int fd_set_udp_gro(int fd);
+
+// msghdr_get_udp_gro returns the segment size of coalesced datagrams
+// in |msg| received from a socket with UDP_GRO enabled.  It returns 0
+// if datagrams are not coalesced.
+size_t msghdr_get_udp_gro(msghdr *msg);
+
+// RecvInfo is the ancillary data of a received datagram.
+struct RecvInfo {
+  unsigned int ecn;
+  // local_addr is the destination address of the datagram.  Its len
+  // is 0 if the packet info is not present.
+  Address local_addr;
+  // gso_size is the segment size of coalesced datagrams, or 0 if
+  // datagrams are not coalesced.
+  size_t gso_size;
+  // drops is the SO_RXQ_OVFL counter of the socket, that is, the
+  // number of datagrams dropped so far.  It is 0 if absent.
+  uint32_t drops;
+};
+
+// msghdr_get_recv_info scans the ancillary data in |msg| once, and
+// stores ECN bits, local address, UDP_GRO segment size, and
+// SO_RXQ_OVFL counter into |ri|.
+// It is equivalent to msghdr_get_ecn, msghdr_get_local_addr, and
+// msghdr_get_udp_gro combined, each of which scans |msg| by itself.
+void msghdr_get_recv_info(RecvInfo &ri, msghdr *msg);
+
+#ifdef HAVE_RECVMMSG
+// RecvBatchInfo is the ancillary data of the datagrams received by a
+// single recvmmsg call in struct-of-arrays layout.  The i-th element
+// of each array belongs to the i-th message.
+struct RecvBatchInfo {
+  // resize makes room for |n| messages.
+  void resize(size_t n);
+
+  // pi contains ECN bits, and can be passed to ngtcp2_conn_read_pkt
+  // and ngtcp2_conn_read_pkts as is.
+  std::vector<ngtcp2_pkt_info> pi;
+  // local_addr is the destination address.  Its len is 0 if the
+  // packet info is not present.
+  std::vector<Address> local_addr;
+  // gso_size is the segment size of coalesced datagrams, or 0 if
+  // datagrams are not coalesced.
+  std::vector<size_t> gso_size;
+  // drops is the SO_RXQ_OVFL counter of the socket, or 0 if absent.
+  std::vector<uint32_t> drops;
+};
+
+// mmsghdr_get_recv_info scans the ancillary data of the first |nmsg|
+// messages in |msgs| in one pass, and stores them into |info| which
+// must have room for |nmsg| messages.
+void mmsghdr_get_recv_info(RecvBatchInfo &info, mmsghdr *msgs, size_t nmsg);
+#endif // HAVE_RECVMMSG
+
+// fd_set_txtime enables SO_TXTIME socket option to |fd| so that the
+// earliest departure time of each message can be given by
+// SCM_TXTIME ancillary data.  It returns 0 if it succeeds, or -1.
+int fd_set_txtime(int fd);
+
+// fd_set_incoming_cpu sets SO_INCOMING_CPU socket option to |fd| so
+// that the kernel prefers |fd| among its SO_REUSEPORT group for the
+// packets processed on |cpu|.  It returns 0 if it succeeds, or -1.
+int fd_set_incoming_cpu(int fd, int cpu);
+
+// fd_set_busy_poll sets SO_BUSY_POLL socket option to |fd| so that a
+// read on |fd| busy polls the device queue for up to |usec|
+// microseconds.  It returns 0 if it succeeds, or -1.
+int fd_set_busy_poll(int fd, int usec);
+
+// fd_set_rxq_ovfl enables SO_RXQ_OVFL socket option to |fd| so that
+// the number of datagrams dropped by the kernel is attached to each
+// received datagram.
+void fd_set_rxq_ovfl(int fd);
+
+// fd_set_sock_bufsize sets SO_RCVBUF and SO_SNDBUF of |fd| to
+// |size|.  The kernel caps it to net.core.rmem_max and
+// net.core.wmem_max respectively.  It returns 0 if it succeeds, or -1.
+int fd_set_sock_bufsize(int fd, int size);
+
+// fd_get_rcvbuf returns SO_RCVBUF of |fd| as is set by
+// fd_set_sock_bufsize, or -1.
+int fd_get_rcvbuf(int fd);
+
 void set_port(Address &dst, Address &src);
 
 // get_local_addr stores preferred local address (interface address)
@@ -0,0 +1,564 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// spinwatch measures RTT from the latency spin bit (RFC 9000 section
+// 17.4) of the QUIC short header packets in a pcap file, as an
+// on-path observer does.  The spin value flips once per RTT, so that
+// the interval between the flips seen in one direction of a flow is
+// an RTT sample.  The samples are comparable to smoothed_rtt in
+// ngtcp2_conn_stat of the endpoints if they enable
+// ngtcp2_settings.spin_bit.
+//
+// The classic pcap format is read without libpcap.  pcapng is not
+// supported; convert it with "editcap -F pcap".
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <map>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <getopt.h>
+
+namespace {
+// Link types which spinwatch understands.
+enum LinkType : uint32_t {
+  LINKTYPE_NULL = 0,
+  LINKTYPE_ETHERNET = 1,
+  LINKTYPE_RAW = 101,
+  LINKTYPE_LINUX_SLL = 113,
+  LINKTYPE_LINUX_SLL2 = 276,
+};
+
+constexpr uint8_t IPPROTO_UDP_NUM = 17;
+constexpr uint16_t ETHERTYPE_IPV4 = 0x0800;
+constexpr uint16_t ETHERTYPE_IPV6 = 0x86dd;
+constexpr uint16_t ETHERTYPE_VLAN = 0x8100;
+constexpr uint16_t ETHERTYPE_QINQ = 0x88a8;
+constexpr uint8_t QUIC_HEADER_FORM_BIT = 0x80;
+constexpr uint8_t QUIC_FIXED_BIT = 0x40;
+constexpr uint8_t QUIC_SPIN_BIT = 0x20;
+} // namespace
+
+namespace {
+struct Config {
+  // port, if nonzero, selects the UDP datagrams whose source or
+  // destination port is port.
+  uint16_t port;
+  // grease_quic_bit accepts the short header packets without Fixed
+  // Bit, which the endpoints send if they negotiate Greasing QUIC Bit
+  // extension.
+  bool grease_quic_bit;
+  // quiet suppresses the output of each sample.
+  bool quiet;
+} config;
+} // namespace
+
+namespace {
+// Endpoint is an IP address and UDP port.  addr holds IPv4 address
+// in its first 4 bytes.
+struct Endpoint {
+  int family;
+  std::array<uint8_t, 16> addr;
+  uint16_t port;
+
+  auto key() const { return std::tie(family, addr, port); }
+  bool operator<(const Endpoint &other) const { return key() < other.key(); }
+};
+} // namespace
+
+namespace {
+std::string format_endpoint(const Endpoint &ep) {
+  char host[INET6_ADDRSTRLEN];
+
+  inet_ntop(ep.family, ep.addr.data(), host, sizeof(host));
+
+  if (ep.family == AF_INET6) {
+    return '[' + std::string{host} + "]:" + std::to_string(ep.port);
+  }
+
+  return std::string{host} + ':' + std::to_string(ep.port);
+}
+} // namespace
+
+namespace {
+// Flow is one direction of a QUIC connection as the observer sees it.
+struct Flow {
+  // spin is the spin value of the last packet.
+  bool spin;
+  // edge_ts is the time of the last spin flip.  It is nullopt until
+  // the first flip is seen, because the time since the first packet
+  // is not an RTT.
+  std::optional<uint64_t> edge_ts;
+  // rtts is the RTT samples in nanoseconds.
+  std::vector<uint64_t> rtts;
+  // npkts is the number of short header packets seen.
+  size_t npkts;
+};
+} // namespace
+
+namespace {
+uint16_t get_uint16be(const uint8_t *p) {
+  return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+} // namespace
+
+namespace {
+class PcapReader {
+public:
+  PcapReader(FILE *fp) : fp_{fp} {}
+
+  // read_header reads the global header.  It returns false if the
+  // file is not a classic pcap file.
+  bool read_header() {
+    uint8_t hd[24];
+
+    if (std::fread(hd, 1, sizeof(hd), fp_) != sizeof(hd)) {
+      return false;
+    }
+
+    uint32_t magic;
+    std::memcpy(&magic, hd, sizeof(magic));
+
+    switch (magic) {
+    case 0xa1b2c3d4:
+      break;
+    case 0xd4c3b2a1:
+      swapped_ = true;
+      break;
+    case 0xa1b23c4d:
+      nsec_ = true;
+      break;
+    case 0x4d3cb2a1:
+      swapped_ = true;
+      nsec_ = true;
+      break;
+    default:
+      return false;
+    }
+
+    linktype_ = get_uint32(hd + 20) & 0x0fffffff;
+
+    return true;
+  }
+
+  // next reads the next record into |data| and sets its timestamp in
+  // nanoseconds to |ts|.  It returns false at the end of file.
+  bool next(std::vector<uint8_t> &data, uint64_t &ts) {
+    uint8_t hd[16];
+
+    if (std::fread(hd, 1, sizeof(hd), fp_) != sizeof(hd)) {
+      return false;
+    }
+
+    auto sec = get_uint32(hd);
+    auto frac = get_uint32(hd + 4);
+    auto caplen = get_uint32(hd + 8);
+
+    if (caplen > 256 * 1024) {
+      std::fprintf(stderr, "spinwatch: record is too large\n");
+      return false;
+    }
+
+    ts = static_cast<uint64_t>(sec) * 1'000'000'000 +
+         (nsec_ ? frac : static_cast<uint64_t>(frac) * 1000);
+
+    data.resize(caplen);
+
+    return std::fread(data.data(), 1, caplen, fp_) == caplen;
+  }
+
+  uint32_t linktype() const { return linktype_; }
+
+private:
+  uint32_t get_uint32(const uint8_t *p) const {
+    uint32_t n;
+    std::memcpy(&n, p, sizeof(n));
+    return swapped_ ? __builtin_bswap32(n) : n;
+  }
+
+  FILE *fp_;
+  uint32_t linktype_{};
+  bool swapped_{};
+  bool nsec_{};
+};
+} // namespace
+
+namespace {
+// Datagram is the UDP payload of a captured packet.
+struct Datagram {
+  Endpoint src, dst;
+  const uint8_t *payload;
+  size_t payloadlen;
+};
+} // namespace
+
+namespace {
+// decode_ip decodes IPv4 or IPv6 packet |p| of length |len| carrying
+// UDP.  Fragments and IPv6 extension headers are not supported.
+std::optional<Datagram> decode_ip(const uint8_t *p, size_t len) {
+  Datagram dg{};
+
+  if (len < 1) {
+    return {};
+  }
+
+  switch (p[0] >> 4) {
+  case 4: {
+    if (len < 20) {
+      return {};
+    }
+
+    size_t ihl = (p[0] & 0xf) * 4;
+
+    if (ihl < 20 || len < ihl || p[9] != IPPROTO_UDP_NUM ||
+        (get_uint16be(p + 6) & 0x3fff)) {
+      return {};
+    }
+
+    dg.src.family = dg.dst.family = AF_INET;
+    std::copy_n(p + 12, 4, std::begin(dg.src.addr));
+    std::copy_n(p + 16, 4, std::begin(dg.dst.addr));
+
+    p += ihl;
+    len -= ihl;
+
+    break;
+  }
+  case 6:
+    if (len < 40 || p[6] != IPPROTO_UDP_NUM) {
+      return {};
+    }
+
+    dg.src.family = dg.dst.family = AF_INET6;
+    std::copy_n(p + 8, 16, std::begin(dg.src.addr));
+    std::copy_n(p + 24, 16, std::begin(dg.dst.addr));
+
+    p += 40;
+    len -= 40;
+
+    break;
+  default:
+    return {};
+  }
+
+  if (len < 8) {
+    return {};
+  }
+
+  dg.src.port = get_uint16be(p);
+  dg.dst.port = get_uint16be(p + 2);
+
+  // The captured length might be shorter than UDP length, but the
+  // first byte is all spinwatch needs.
+  dg.payload = p + 8;
+  dg.payloadlen = len - 8;
+
+  return dg;
+}
+} // namespace
+
+namespace {
+// decode_link strips the link layer header of |linktype| from |p| of
+// length |len|, and decodes the rest.
+std::optional<Datagram> decode_link(uint32_t linktype, const uint8_t *p,
+                                    size_t len) {
+  uint16_t ethertype;
+
+  switch (linktype) {
+  case LINKTYPE_NULL:
+    if (len < 4) {
+      return {};
+    }
+    // The address family is in the host byte order of the capturing
+    // machine.  Let decode_ip tell IPv4 from IPv6.
+    return decode_ip(p + 4, len - 4);
+  case LINKTYPE_RAW:
+    return decode_ip(p, len);
+  case LINKTYPE_ETHERNET:
+    if (len < 14) {
+      return {};
+    }
+
+    ethertype = get_uint16be(p + 12);
+    p += 14;
+    len -= 14;
+
+    while ((ethertype == ETHERTYPE_VLAN || ethertype == ETHERTYPE_QINQ) &&
+           len >= 4) {
+      ethertype = get_uint16be(p + 2);
+      p += 4;
+      len -= 4;
+    }
+
+    break;
+  case LINKTYPE_LINUX_SLL:
+    if (len < 16) {
+      return {};
+    }
+
+    ethertype = get_uint16be(p + 14);
+    p += 16;
+    len -= 16;
+
+    break;
+  case LINKTYPE_LINUX_SLL2:
+    if (len < 20) {
+      return {};
+    }
+
+    ethertype = get_uint16be(p);
+    p += 20;
+    len -= 20;
+
+    break;
+  default:
+    return {};
+  }
+
+  if (ethertype != ETHERTYPE_IPV4 && ethertype != ETHERTYPE_IPV6) {
+    return {};
+  }
+
+  return decode_ip(p, len);
+}
+} // namespace
+
+namespace {
+void print_summary(const std::map<std::pair<Endpoint, Endpoint>, Flow> &flows) {
+  for (auto &[key, flow] : flows) {
+    auto &[src, dst] = key;
+
+    std::fprintf(stderr, "%s -> %s: packets=%zu samples=%zu",
+                 format_endpoint(src).c_str(), format_endpoint(dst).c_str(),
+                 flow.npkts, flow.rtts.size());
+
+    if (flow.rtts.empty()) {
+      std::fprintf(stderr, "\n");
+      continue;
+    }
+
+    auto rtts = flow.rtts;
+    std::sort(std::begin(rtts), std::end(rtts));
+
+    std::fprintf(stderr, " min=%.3fms median=%.3fms max=%.3fms\n",
+                 static_cast<double>(rtts.front()) / 1'000'000,
+                 static_cast<double>(rtts[rtts.size() / 2]) / 1'000'000,
+                 static_cast<double>(rtts.back()) / 1'000'000);
+  }
+}
+} // namespace
+
+namespace {
+int watch(FILE *fp) {
+  PcapReader reader{fp};
+
+  if (!reader.read_header()) {
+    std::fprintf(stderr, "spinwatch: not a pcap file\n");
+    return -1;
+  }
+
+  switch (reader.linktype()) {
+  case LINKTYPE_NULL:
+  case LINKTYPE_ETHERNET:
+  case LINKTYPE_RAW:
+  case LINKTYPE_LINUX_SLL:
+  case LINKTYPE_LINUX_SLL2:
+    break;
+  default:
+    std::fprintf(stderr, "spinwatch: unsupported link type %" PRIu32 "\n",
+                 reader.linktype());
+    return -1;
+  }
+
+  std::map<std::pair<Endpoint, Endpoint>, Flow> flows;
+  std::vector<uint8_t> data;
+  uint64_t ts;
+  std::optional<uint64_t> first_ts;
+
+  while (reader.next(data, ts)) {
+    auto dg = decode_link(reader.linktype(), data.data(), data.size());
+    if (!dg || dg->payloadlen == 0) {
+      continue;
+    }
+
+    if (config.port && dg->src.port != config.port &&
+        dg->dst.port != config.port) {
+      continue;
+    }
+
+    auto b = dg->payload[0];
+
+    if ((b & QUIC_HEADER_FORM_BIT) ||
+        (!config.grease_quic_bit && !(b & QUIC_FIXED_BIT))) {
+      continue;
+    }
+
+    if (!first_ts) {
+      first_ts = ts;
+    }
+
+    auto [it, inserted] = flows.try_emplace({dg->src, dg->dst});
+    auto &flow = it->second;
+    bool spin = b & QUIC_SPIN_BIT;
+
+    ++flow.npkts;
+
+    if (inserted) {
+      flow.spin = spin;
+      continue;
+    }
+
+    if (flow.spin == spin) {
+      continue;
+    }
+
+    flow.spin = spin;
+
+    if (flow.edge_ts) {
+      auto rtt = ts - *flow.edge_ts;
+
+      flow.rtts.push_back(rtt);
+
+      if (!config.quiet) {
+        std::printf("%.6f %s -> %s rtt=%.3fms\n",
+                    static_cast<double>(ts - *first_ts) / 1'000'000'000,
+                    format_endpoint(dg->src).c_str(),
+                    format_endpoint(dg->dst).c_str(),
+                    static_cast<double>(rtt) / 1'000'000);
+      }
+    }
+
+    flow.edge_ts = ts;
+  }
+
+  print_summary(flows);
+
+  return 0;
+}
+} // namespace
+
+namespace {
+void print_help() {
+  std::printf(R"(Usage: spinwatch [OPTIONS] [<PCAP>]
+Measure RTT from the latency spin bit of QUIC short header packets in
+<PCAP>, which defaults to stdin.  Each RTT sample is printed to stdout
+as "<TIME> <SRC> -> <DST> rtt=<RTT>", where <TIME> is the seconds since
+the first QUIC packet.  The per-flow summary is printed to stderr.
+Flows which do not use the spin bit produce no or bogus samples.
+Options:
+  -p, --port=<PORT>
+              Only  look  at  UDP  datagrams  to  or  from  <PORT>.
+  --grease-quic-bit
+              Accept  the  packets  without Fixed  Bit,  which the
+              endpoints send if  they negotiate Greasing QUIC Bit.
+  -q, --quiet Do not print each sample.
+  -h, --help  Display this help and exit.
+)");
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  for (;;) {
+    static int flag = 0;
+    constexpr static option long_opts[] = {
+        {"port", required_argument, nullptr, 'p'},
+        {"quiet", no_argument, nullptr, 'q'},
+        {"help", no_argument, nullptr, 'h'},
+        {"grease-quic-bit", no_argument, &flag, 1},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    auto optidx = 0;
+    auto c = getopt_long(argc, argv, "hp:q", long_opts, &optidx);
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case 'h':
+      print_help();
+      exit(EXIT_SUCCESS);
+    case 'p': {
+      char *end;
+      errno = 0;
+      auto n = std::strtoul(optarg, &end, 10);
+      if (errno || *end || n == 0 || n > 65535) {
+        std::fprintf(stderr, "port: invalid argument\n");
+        exit(EXIT_FAILURE);
+      }
+      config.port = static_cast<uint16_t>(n);
+      break;
+    }
+    case 'q':
+      config.quiet = true;
+      break;
+    case '?':
+      exit(EXIT_FAILURE);
+    case 0:
+      switch (flag) {
+      case 1:
+        // --grease-quic-bit
+        config.grease_quic_bit = true;
+        break;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  if (argc - optind > 1) {
+    print_help();
+    exit(EXIT_FAILURE);
+  }
+
+  auto fp = stdin;
+  if (argc - optind == 1 && std::strcmp(argv[optind], "-") != 0) {
+    fp = std::fopen(argv[optind], "rb");
+    if (!fp) {
+      std::fprintf(stderr, "spinwatch: could not open %s: %s\n", argv[optind],
+                   std::strerror(errno));
+      return EXIT_FAILURE;
+    }
+  }
+
+  auto rv = watch(fp);
+
+  if (fp != stdin) {
+    std::fclose(fp);
+  }
+
+  return rv == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
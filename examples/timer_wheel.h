@@ -0,0 +1,305 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <cassert>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <bit>
+
+#include <ngtcp2/ngtcp2.h>
+
+// TimerWheelEntry is an intrusive timer which is scheduled in
+// TimerWheel.  The owner embeds it and keeps it alive while it is
+// scheduled.
+struct TimerWheelEntry {
+  // data is an opaque pointer which the owner can use to find itself
+  // from the expired entry.
+  void *data;
+  // expiry is the timestamp passed to TimerWheel::schedule.
+  ngtcp2_tstamp expiry;
+  TimerWheelEntry *prev;
+  TimerWheelEntry *next;
+  // slot is the index of the list which this entry belongs to, or
+  // TimerWheel::NO_SLOT if it is not scheduled.
+  size_t slot;
+};
+
+// TimerWheel is a hierarchical timer wheel which schedules the
+// expiry of a large number of connections in O(1).  Level 0 has the
+// finest granularity (2^17 ns, about 131us) which suits loss
+// detection and pacing timers.  Each subsequent level is 8 times
+// coarser, so idle and keep-alive timers land in the upper levels.
+// Entries are never cascaded down.  Instead, an expiry is rounded up
+// to the granularity of its level, so that an entry never fires
+// early.  It fires late by at most about 1/8 of the remaining
+// duration at the time it was scheduled, or 1 tick of level 0.  The
+// caller drives the wheel with next_expiry and expire, e.g., with a
+// single ev_timer.
+class TimerWheel {
+public:
+  static constexpr size_t NO_SLOT = SIZE_MAX;
+  // EXPIRED_SLOT is the slot of the entries which are collected by
+  // expire but whose callback has not been called yet.
+  static constexpr size_t EXPIRED_SLOT = SIZE_MAX - 1;
+
+  static constexpr size_t TICK_SHIFT = 17;
+  static constexpr size_t LEVEL_SHIFT = 3;
+  static constexpr size_t LEVEL_SIZE = 64;
+  static constexpr size_t NLEVEL = 8;
+
+  // |now| is the current timestamp.
+  explicit TimerWheel(ngtcp2_tstamp now = 0)
+      : clk_(now >> TICK_SHIFT), occupied_{}, size_(0) {
+    for (auto &l : slots_) {
+      l.prev = l.next = &l;
+    }
+    expired_.prev = expired_.next = &expired_;
+  }
+
+  TimerWheel(const TimerWheel &) = delete;
+  TimerWheel &operator=(const TimerWheel &) = delete;
+
+  static void init_entry(TimerWheelEntry *e, void *data) {
+    *e = {
+        .data = data,
+        .expiry = UINT64_MAX,
+        .prev = nullptr,
+        .next = nullptr,
+        .slot = NO_SLOT,
+    };
+  }
+
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+
+  // schedule (re)schedules |e| to expire at |expiry|.  If |expiry| is
+  // UINT64_MAX, |e| is cancelled.
+  void schedule(TimerWheelEntry *e, ngtcp2_tstamp expiry) {
+    cancel(e);
+
+    if (expiry == UINT64_MAX) {
+      return;
+    }
+
+    e->expiry = expiry;
+
+    // Round up, so that the entry does not fire before expiry.
+    uint64_t tick = (expiry >> TICK_SHIFT) +
+                    ((expiry & ((1ull << TICK_SHIFT) - 1)) != 0);
+    if (tick <= clk_) {
+      tick = clk_ + 1;
+    }
+
+    auto delta = tick - clk_;
+    size_t level = 0;
+
+    // idx - (clk_ >> shift) must stay in [1, LEVEL_SIZE - 1] so that
+    // the entry does not wrap around its level.
+    for (; level < NLEVEL - 1 &&
+           delta > (LEVEL_SIZE - 2) << (level * LEVEL_SHIFT);
+         ++level)
+      ;
+
+    auto shift = level * LEVEL_SHIFT;
+    uint64_t idx = (tick + (1ull << shift) - 1) >> shift;
+
+    if (level == NLEVEL - 1) {
+      // The farthest entry is clamped to the horizon of the wheel.
+      // The owner reschedules it when it fires.
+      idx = std::min(idx, (clk_ >> shift) + LEVEL_SIZE - 1);
+    }
+
+    auto slot = level * LEVEL_SIZE + (idx & (LEVEL_SIZE - 1));
+
+    link(&slots_[slot], e);
+    e->slot = slot;
+    occupied_[level] |= 1ull << (slot & (LEVEL_SIZE - 1));
+    ++size_;
+  }
+
+  // cancel removes |e| from the wheel if it is scheduled.
+  void cancel(TimerWheelEntry *e) {
+    if (e->slot == NO_SLOT) {
+      return;
+    }
+
+    unlink(e);
+
+    if (e->slot != EXPIRED_SLOT) {
+      auto &l = slots_[e->slot];
+      if (l.next == &l) {
+        occupied_[e->slot / LEVEL_SIZE] &=
+            ~(1ull << (e->slot & (LEVEL_SIZE - 1)));
+      }
+    }
+
+    e->slot = NO_SLOT;
+    --size_;
+  }
+
+  // next_expiry returns the timestamp at which the earliest entry
+  // fires, or UINT64_MAX if the wheel is empty.
+  ngtcp2_tstamp next_expiry() const {
+    if (size_ == 0) {
+      return UINT64_MAX;
+    }
+
+    if (expired_.next != &expired_) {
+      return 0;
+    }
+
+    auto tick = next_tick();
+    if (tick == UINT64_MAX) {
+      return UINT64_MAX;
+    }
+
+    return tick << TICK_SHIFT;
+  }
+
+  // expire advances the wheel to |now| and calls |f| with each entry
+  // which has expired.  The entry is removed from the wheel before
+  // |f| is called, and |f| may schedule or cancel any entry.  It
+  // returns the number of expired entries.
+  template <typename F> size_t expire(ngtcp2_tstamp now, F &&f) {
+    auto target = now >> TICK_SHIFT;
+    size_t n = 0;
+
+    for (;;) {
+      // Collect the expired entries first, so that the entries which
+      // f schedules for the current tick are not processed in this
+      // call.
+      for (;;) {
+        auto tick = next_tick();
+        if (tick > target) {
+          if (target > clk_) {
+            clk_ = target;
+          }
+          break;
+        }
+
+        clk_ = tick;
+        collect();
+      }
+
+      if (expired_.next == &expired_) {
+        return n;
+      }
+
+      while (expired_.next != &expired_) {
+        auto e = expired_.next;
+
+        unlink(e);
+        e->slot = NO_SLOT;
+        --size_;
+        ++n;
+
+        f(e);
+      }
+    }
+  }
+
+private:
+  // link appends |e| to the circular list whose sentinel is |l|.
+  void link(TimerWheelEntry *l, TimerWheelEntry *e) {
+    e->next = l;
+    e->prev = l->prev;
+    l->prev->next = e;
+    l->prev = e;
+  }
+
+  void unlink(TimerWheelEntry *e) {
+    e->prev->next = e->next;
+    e->next->prev = e->prev;
+    e->prev = e->next = nullptr;
+  }
+
+  // next_tick returns the level 0 tick at which the earliest
+  // occupied slot fires.
+  uint64_t next_tick() const {
+    auto res = UINT64_MAX;
+
+    for (size_t level = 0; level < NLEVEL; ++level) {
+      auto bits = occupied_[level];
+      if (!bits) {
+        continue;
+      }
+
+      auto shift = level * LEVEL_SHIFT;
+      auto idx = clk_ >> shift;
+      auto pos = idx & (LEVEL_SIZE - 1);
+      // Rotate so that bit 0 corresponds to the slot of idx + 1.
+      auto rot = std::rotr(bits, static_cast<int>((pos + 1) & 63));
+      auto dist = static_cast<uint64_t>(std::countr_zero(rot)) + 1;
+
+      res = std::min(res, (idx + dist) << shift);
+    }
+
+    return res;
+  }
+
+  // collect moves the entries which fire at clk_ to expired_.
+  void collect() {
+    auto clk = clk_;
+
+    for (size_t level = 0; level < NLEVEL; ++level) {
+      auto pos = clk & (LEVEL_SIZE - 1);
+      auto &l = slots_[level * LEVEL_SIZE + pos];
+
+      while (l.next != &l) {
+        auto e = l.next;
+        unlink(e);
+        link(&expired_, e);
+        e->slot = EXPIRED_SLOT;
+      }
+
+      occupied_[level] &= ~(1ull << pos);
+
+      // The upper level fires only when the lower level wraps.
+      if (clk & ((1 << LEVEL_SHIFT) - 1)) {
+        break;
+      }
+
+      clk >>= LEVEL_SHIFT;
+    }
+  }
+
+  // slots_ and expired_ are the sentinels of the circular lists.
+  std::array<TimerWheelEntry, NLEVEL * LEVEL_SIZE> slots_;
+  TimerWheelEntry expired_;
+  // clk_ is the last level 0 tick which has been processed.
+  uint64_t clk_;
+  // occupied_ is the bitmap of the non-empty slots of each level.
+  std::array<uint64_t, NLEVEL> occupied_;
+  size_t size_;
+};
+
+#endif // TIMER_WHEEL_H
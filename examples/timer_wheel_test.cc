@@ -0,0 +1,151 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "timer_wheel_test.h"
+
+#include <random>
+#include <vector>
+
+#include <CUnit/CUnit.h>
+
+#include "timer_wheel.h"
+
+namespace ngtcp2 {
+
+void test_timer_wheel_expire() {
+  TimerWheel w;
+  std::array<TimerWheelEntry, 3> ents;
+  std::vector<TimerWheelEntry *> fired;
+  auto f = [&fired](TimerWheelEntry *e) { fired.push_back(e); };
+
+  for (auto &e : ents) {
+    TimerWheel::init_entry(&e, nullptr);
+  }
+
+  CU_ASSERT(UINT64_MAX == w.next_expiry());
+
+  w.schedule(&ents[0], 10 * NGTCP2_MILLISECONDS);
+  w.schedule(&ents[1], 1 * NGTCP2_MILLISECONDS);
+  w.schedule(&ents[2], 1 * NGTCP2_MILLISECONDS + 1);
+
+  CU_ASSERT(3 == w.size());
+  CU_ASSERT(w.next_expiry() >= 1 * NGTCP2_MILLISECONDS);
+  CU_ASSERT(w.next_expiry() < 1 * NGTCP2_MILLISECONDS +
+                                  (1 << TimerWheel::TICK_SHIFT));
+
+  // Nothing fires early.
+  CU_ASSERT(0 == w.expire(1 * NGTCP2_MILLISECONDS - 1, f));
+
+  CU_ASSERT(2 == w.expire(2 * NGTCP2_MILLISECONDS, f));
+  CU_ASSERT(2 == fired.size());
+  CU_ASSERT(&ents[1] == fired[0]);
+  CU_ASSERT(&ents[2] == fired[1]);
+  CU_ASSERT(TimerWheel::NO_SLOT == ents[1].slot);
+
+  // An expiry in the past fires at the next call.
+  w.schedule(&ents[1], 0);
+
+  CU_ASSERT(1 == w.expire(2 * NGTCP2_MILLISECONDS +
+                              (1 << TimerWheel::TICK_SHIFT),
+                          f));
+  CU_ASSERT(&ents[1] == fired[2]);
+
+  // The callback can reschedule the entry.
+  CU_ASSERT(1 == w.expire(20 * NGTCP2_MILLISECONDS,
+                          [&w](TimerWheelEntry *e) {
+                            w.schedule(e, 30 * NGTCP2_MILLISECONDS);
+                          }));
+  CU_ASSERT(1 == w.size());
+  // 10ms ahead is in level 1 whose granularity is 8 ticks.
+  CU_ASSERT(0 == w.expire(30 * NGTCP2_MILLISECONDS - 1, f));
+  CU_ASSERT(1 == w.expire(30 * NGTCP2_MILLISECONDS +
+                              (8 << TimerWheel::TICK_SHIFT),
+                          f));
+  CU_ASSERT(w.empty());
+}
+
+void test_timer_wheel_cancel() {
+  TimerWheel w;
+  std::array<TimerWheelEntry, 2> ents;
+  size_t n = 0;
+
+  for (auto &e : ents) {
+    TimerWheel::init_entry(&e, nullptr);
+    w.schedule(&e, 5 << TimerWheel::TICK_SHIFT);
+  }
+
+  // Cancelling an entry which has been collected but whose callback
+  // has not been called yet.
+  CU_ASSERT(1 == w.expire(5 << TimerWheel::TICK_SHIFT,
+                          [&w, &ents, &n](TimerWheelEntry *e) {
+                            ++n;
+                            w.cancel(e == &ents[0] ? &ents[1] : &ents[0]);
+                          }));
+  CU_ASSERT(1 == n);
+  CU_ASSERT(w.empty());
+
+  w.schedule(&ents[0], 10 * NGTCP2_MILLISECONDS);
+  w.cancel(&ents[0]);
+  w.cancel(&ents[0]);
+
+  CU_ASSERT(w.empty());
+  CU_ASSERT(UINT64_MAX == w.next_expiry());
+
+  w.schedule(&ents[0], 10 * NGTCP2_MILLISECONDS);
+  w.schedule(&ents[0], UINT64_MAX);
+
+  CU_ASSERT(w.empty());
+}
+
+void test_timer_wheel_levels() {
+  auto now = 1000 * NGTCP2_SECONDS;
+  TimerWheel w(now);
+  std::vector<TimerWheelEntry> ents(10000);
+  std::mt19937 gen(0);
+  std::uniform_int_distribution<uint64_t> dis(0, 3600 * NGTCP2_SECONDS);
+  size_t nfired = 0;
+
+  for (auto &e : ents) {
+    TimerWheel::init_entry(&e, nullptr);
+    w.schedule(&e, now + dis(gen));
+  }
+
+  // Each entry fires at or after its expiry, and not much later.
+  while (!w.empty()) {
+    auto t = w.next_expiry();
+
+    CU_ASSERT(t > now);
+
+    now = t;
+    nfired += w.expire(now, [now](TimerWheelEntry *e) {
+      CU_ASSERT(e->expiry <= now);
+      CU_ASSERT(now - e->expiry <= (1 << TimerWheel::TICK_SHIFT) ||
+                now - e->expiry <= (e->expiry - 1000 * NGTCP2_SECONDS) / 7);
+    });
+  }
+
+  CU_ASSERT(ents.size() == nfired);
+}
+
+} // namespace ngtcp2
@@ -0,0 +1,255 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2018 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// timerbench compares TimerWheel against per-connection ev_timer
+// under the timer workload of a busy server: every connection
+// reschedules its timer repeatedly, mostly with short delays (ACK
+// delay, pacing and loss detection), and sometimes with long ones
+// (idle and keep-alive timeout).  The result is written to stdout in
+// JSON.
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <getopt.h>
+
+#include <ev.h>
+
+#include "timer_wheel.h"
+
+namespace {
+// Update is a single reschedule of the timer of a connection.
+struct Update {
+  size_t conn;
+  ngtcp2_duration delay;
+};
+
+// Result is the outcome of a benchmark run.
+struct Result {
+  // ns is the time spent in rescheduling and expiring timers.
+  uint64_t ns;
+  // nexpired is the number of timers which have expired.
+  uint64_t nexpired;
+};
+
+// EXPIRE_INTERVAL is the number of updates between the calls which
+// process expired timers.  It models the number of packets which an
+// event loop iteration handles.
+constexpr size_t EXPIRE_INTERVAL = 64;
+
+ngtcp2_tstamp timestamp() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+std::vector<Update> make_updates(size_t nconn, size_t nupdate,
+                                 uint64_t seed) {
+  std::mt19937_64 gen(seed);
+  std::uniform_int_distribution<size_t> conn_dis(0, nconn - 1);
+  std::uniform_int_distribution<uint32_t> kind_dis(0, 99);
+  std::vector<Update> updates(nupdate);
+
+  for (auto &u : updates) {
+    u.conn = conn_dis(gen);
+
+    auto kind = kind_dis(gen);
+    if (kind < 70) {
+      // ACK delay and pacing
+      u.delay = std::uniform_int_distribution<ngtcp2_duration>(
+          100 * NGTCP2_MICROSECONDS, 2 * NGTCP2_MILLISECONDS)(gen);
+    } else if (kind < 95) {
+      // Loss detection and PTO
+      u.delay = std::uniform_int_distribution<ngtcp2_duration>(
+          20 * NGTCP2_MILLISECONDS, 300 * NGTCP2_MILLISECONDS)(gen);
+    } else {
+      // Idle and keep-alive timeout
+      u.delay = std::uniform_int_distribution<ngtcp2_duration>(
+          15 * NGTCP2_SECONDS, 30 * NGTCP2_SECONDS)(gen);
+    }
+  }
+
+  return updates;
+}
+
+void ev_timeoutcb(struct ev_loop *loop, ev_timer *w, int revents) {
+  ++*static_cast<uint64_t *>(w->data);
+}
+
+Result bench_ev_timer(size_t nconn, const std::vector<Update> &updates) {
+  auto loop = ev_loop_new(EVFLAG_AUTO);
+  std::vector<ev_timer> timers(nconn);
+  uint64_t nexpired = 0;
+
+  for (auto &t : timers) {
+    ev_timer_init(&t, ev_timeoutcb, 0., 0.);
+    t.data = &nexpired;
+  }
+
+  auto start = timestamp();
+
+  for (size_t i = 0; i < updates.size(); ++i) {
+    auto &u = updates[i];
+    auto &t = timers[u.conn];
+
+    // This is what Handler::update_timer does.
+    t.repeat = static_cast<ev_tstamp>(u.delay) / NGTCP2_SECONDS;
+    ev_timer_again(loop, &t);
+
+    if ((i + 1) % EXPIRE_INTERVAL == 0) {
+      ev_run(loop, EVRUN_NOWAIT);
+    }
+  }
+
+  auto end = timestamp();
+
+  for (auto &t : timers) {
+    ev_timer_stop(loop, &t);
+  }
+
+  ev_loop_destroy(loop);
+
+  return {end - start, nexpired};
+}
+
+Result bench_timer_wheel(size_t nconn, const std::vector<Update> &updates) {
+  auto now = timestamp();
+  TimerWheel wheel(now);
+  std::vector<TimerWheelEntry> ents(nconn);
+  uint64_t nexpired = 0;
+
+  for (auto &e : ents) {
+    TimerWheel::init_entry(&e, nullptr);
+  }
+
+  auto start = timestamp();
+
+  for (size_t i = 0; i < updates.size(); ++i) {
+    auto &u = updates[i];
+
+    wheel.schedule(&ents[u.conn], now + u.delay);
+
+    if ((i + 1) % EXPIRE_INTERVAL == 0) {
+      // Like ev_now, the timestamp is updated once per iteration.
+      now = timestamp();
+      nexpired += wheel.expire(now, [](TimerWheelEntry *e) {});
+    }
+  }
+
+  auto end = timestamp();
+
+  return {end - start, nexpired};
+}
+
+void print_usage() {
+  std::fprintf(stderr, "Usage: timerbench [-n <N>] [-u <N>] [-s <SEED>]\n"
+                       "  -n  The number of connections.  Default: 100000\n"
+                       "  -u  The number of timer updates.  Default: "
+                       "10000000\n"
+                       "  -s  The seed of the workload.  Default: 0\n");
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t nconn = 100000;
+  size_t nupdate = 10000000;
+  uint64_t seed = 0;
+
+  for (;;) {
+    auto c = getopt(argc, argv, "n:u:s:h");
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case 'n':
+      nconn = std::strtoul(optarg, nullptr, 10);
+      break;
+    case 'u':
+      nupdate = std::strtoul(optarg, nullptr, 10);
+      break;
+    case 's':
+      seed = std::strtoull(optarg, nullptr, 10);
+      break;
+    case 'h':
+      print_usage();
+      return EXIT_SUCCESS;
+    default:
+      print_usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (nconn == 0) {
+    std::fprintf(stderr, "timerbench: the number of connections must be "
+                         "positive\n");
+    return EXIT_FAILURE;
+  }
+
+  auto updates = make_updates(nconn, nupdate, seed);
+
+  struct {
+    const char *name;
+    Result (*func)(size_t, const std::vector<Update> &);
+  } benches[] = {
+      {"ev_timer", bench_ev_timer},
+      {"timer_wheel", bench_timer_wheel},
+  };
+
+  std::printf("{\n"
+              "  \"connections\": %zu,\n"
+              "  \"updates\": %zu,\n"
+              "  \"seed\": %" PRIu64 ",\n"
+              "  \"benchmarks\": [",
+              nconn, nupdate, seed);
+
+  auto first = true;
+
+  for (auto &b : benches) {
+    auto res = b.func(nconn, updates);
+
+    std::printf("%s\n"
+                "    {\n"
+                "      \"name\": \"%s\",\n"
+                "      \"ns\": %" PRIu64 ",\n"
+                "      \"expired\": %" PRIu64 ",\n"
+                "      \"ns_per_update\": %.2f\n"
+                "    }",
+                first ? "" : ",", b.name, res.ns, res.nexpired,
+                nupdate ? static_cast<double>(res.ns) / nupdate : 0.);
+
+    first = false;
+  }
+
+  std::printf("\n  ]\n}\n");
+
+  return EXIT_SUCCESS;
+}
@@ -33,6 +33,7 @@
 
 #include "client_base.h"
 #include "template.h"
+#include "tls_shared_boringssl.h"
 
 extern Config config;
 
@@ -48,6 +49,27 @@ SSL_CTX *TLSClientContext::get_native_handle() const { return ssl_ctx_; }
 
 namespace {
 int new_session_cb(SSL *ssl, SSL_SESSION *session) {
+  auto conn_ref = static_cast<ngtcp2_crypto_conn_ref *>(SSL_get_app_data(ssl));
+  auto c = static_cast<ClientBase *>(conn_ref->user_data);
+
+  if (c->resumption_cache()) {
+    auto f = BIO_new(BIO_s_mem());
+    if (f) {
+      if (PEM_write_bio_SSL_SESSION(f, session)) {
+        char *data;
+        auto datalen = BIO_get_mem_data(f, &data);
+
+        c->store_session(std::string{data, static_cast<size_t>(datalen)});
+      }
+
+      BIO_free(f);
+    }
+  }
+
+  if (!should_write_session_file()) {
+    return 0;
+  }
+
   auto f = BIO_new_file(config.session_file, "w");
   if (f == nullptr) {
     std::cerr << "Could not write TLS session in " << config.session_file
@@ -84,6 +106,15 @@ int TLSClientContext::init(const char *private_key_file,
     return -1;
   }
 
+#ifdef HAVE_LIBBROTLI
+  if (!SSL_CTX_add_cert_compression_alg(
+          ssl_ctx_, ngtcp2::tls::CERTIFICATE_COMPRESSION_ALGO_BROTLI,
+          ngtcp2::tls::cert_compress, ngtcp2::tls::cert_decompress)) {
+    std::cerr << "SSL_CTX_add_cert_compression_alg failed" << std::endl;
+    return -1;
+  }
+#endif // HAVE_LIBBROTLI
+
   if (private_key_file && cert_file) {
     if (SSL_CTX_use_PrivateKey_file(ssl_ctx_, private_key_file,
                                     SSL_FILETYPE_PEM) != 1) {
@@ -99,7 +130,7 @@ int TLSClientContext::init(const char *private_key_file,
     }
   }
 
-  if (config.session_file) {
+  if (config.session_file || config.resumption_cache_file) {
     SSL_CTX_set_session_cache_mode(ssl_ctx_, SSL_SESS_CACHE_CLIENT |
                                                  SSL_SESS_CACHE_NO_INTERNAL);
     SSL_CTX_sess_set_new_cb(ssl_ctx_, new_session_cb);
@@ -25,6 +25,7 @@
 #include "tls_client_context_openssl.h"
 
 #include <iostream>
+#include <array>
 #include <fstream>
 #include <limits>
 
@@ -49,6 +50,27 @@ SSL_CTX *TLSClientContext::get_native_handle() const { return ssl_ctx_; }
 
 namespace {
 int new_session_cb(SSL *ssl, SSL_SESSION *session) {
+  auto conn_ref = static_cast<ngtcp2_crypto_conn_ref *>(SSL_get_app_data(ssl));
+  auto c = static_cast<ClientBase *>(conn_ref->user_data);
+
+  if (c->resumption_cache()) {
+    auto f = BIO_new(BIO_s_mem());
+    if (f) {
+      if (PEM_write_bio_SSL_SESSION(f, session)) {
+        char *data;
+        auto datalen = BIO_get_mem_data(f, &data);
+
+        c->store_session(std::string{data, static_cast<size_t>(datalen)});
+      }
+
+      BIO_free(f);
+    }
+  }
+
+  if (!should_write_session_file()) {
+    return 0;
+  }
+
   if (SSL_SESSION_get_max_early_data(session) !=
       std::numeric_limits<uint32_t>::max()) {
     std::cerr << "max_early_data_size is not 0xffffffff" << std::endl;
@@ -69,6 +91,11 @@ int new_session_cb(SSL *ssl, SSL_SESSION *session) {
 
 int TLSClientContext::init(const char *private_key_file,
                            const char *cert_file) {
+  if (ngtcp2_crypto_openssl_init() != 0) {
+    std::cerr << "ngtcp2_crypto_openssl_init failed" << std::endl;
+    return -1;
+  }
+
   ssl_ctx_ = SSL_CTX_new(TLS_client_method());
   if (!ssl_ctx_) {
     std::cerr << "SSL_CTX_new: " << ERR_error_string(ERR_get_error(), nullptr)
@@ -95,6 +122,21 @@ int TLSClientContext::init(const char *private_key_file,
     return -1;
   }
 
+#if OPENSSL_VERSION_NUMBER >= 0x30200000L && !defined(OPENSSL_NO_COMP_ALG)
+  std::array<int, 3> cert_comp_algs{
+      TLSEXT_comp_cert_brotli,
+      TLSEXT_comp_cert_zstd,
+      TLSEXT_comp_cert_zlib,
+  };
+
+  if (SSL_CTX_set1_cert_comp_preference(ssl_ctx_, cert_comp_algs.data(),
+                                        cert_comp_algs.size()) != 1) {
+    std::cerr << "SSL_CTX_set1_cert_comp_preference failed" << std::endl;
+    return -1;
+  }
+#endif // OPENSSL_VERSION_NUMBER >= 0x30200000L &&
+       // !defined(OPENSSL_NO_COMP_ALG)
+
   if (private_key_file && cert_file) {
     if (SSL_CTX_use_PrivateKey_file(ssl_ctx_, private_key_file,
                                     SSL_FILETYPE_PEM) != 1) {
@@ -110,7 +152,7 @@ int TLSClientContext::init(const char *private_key_file,
     }
   }
 
-  if (config.session_file) {
+  if (config.session_file || config.resumption_cache_file) {
     SSL_CTX_set_session_cache_mode(ssl_ctx_, SSL_SESS_CACHE_CLIENT |
                                                  SSL_SESS_CACHE_NO_INTERNAL);
     SSL_CTX_sess_set_new_cb(ssl_ctx_, new_session_cb);
@@ -38,6 +38,10 @@ extern Config config;
 
 namespace {
 int save_ticket_cb(ptls_save_ticket_t *self, ptls_t *ptls, ptls_iovec_t input) {
+  if (!should_write_session_file()) {
+    return 0;
+  }
+
   auto f = BIO_new_file(config.session_file, "w");
   if (f == nullptr) {
     std::cerr << "Could not write TLS session in " << config.session_file
@@ -107,6 +111,10 @@ int TLSClientContext::init(const char *private_key_file,
     ctx_.save_ticket = &save_ticket;
   }
 
+#ifdef HAVE_LIBBROTLI
+  ctx_.decompress_certificate = &ptls_decompress_certificate;
+#endif // HAVE_LIBBROTLI
+
   if (private_key_file && cert_file) {
     if (ptls_load_certificates(&ctx_, cert_file) != 0) {
       std::cerr << "ptls_load_certificates failed" << std::endl;
@@ -31,6 +31,9 @@
 
 #include <picotls.h>
 #include <picotls/openssl.h>
+#ifdef HAVE_LIBBROTLI
+#  include <picotls/certificate_compression.h>
+#endif // HAVE_LIBBROTLI
 
 class TLSClientContext {
 public:
@@ -50,6 +50,10 @@ WOLFSSL_CTX *TLSClientContext::get_native_handle() const { return ssl_ctx_; }
 
 namespace {
 int new_session_cb(WOLFSSL *ssl, WOLFSSL_SESSION *session) {
+  if (!should_write_session_file()) {
+    return 0;
+  }
+
   std::cerr << "new_session_cb called" << std::endl;
 #ifdef HAVE_SESSION_TICKET
   if (wolfSSL_SESSION_get_max_early_data(session) !=
@@ -48,7 +48,8 @@ TLSClientSession::~TLSClientSession() {}
 namespace {
 int hook_func(gnutls_session_t session, unsigned int htype, unsigned when,
               unsigned int incoming, const gnutls_datum_t *msg) {
-  if (config.session_file && htype == GNUTLS_HANDSHAKE_NEW_SESSION_TICKET) {
+  if (should_write_session_file() &&
+      htype == GNUTLS_HANDSHAKE_NEW_SESSION_TICKET) {
     gnutls_datum_t data;
     if (auto rv = gnutls_session_get_data2(session, &data); rv != 0) {
       std::cerr << "gnutls_session_get_data2 failed: " << gnutls_strerror(rv)
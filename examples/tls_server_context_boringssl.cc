@@ -33,6 +33,7 @@
 
 #include "server_base.h"
 #include "template.h"
+#include "tls_shared_boringssl.h"
 
 extern Config config;
 
@@ -46,6 +47,35 @@ TLSServerContext::~TLSServerContext() {
 
 SSL_CTX *TLSServerContext::get_native_handle() const { return ssl_ctx_; }
 
+namespace {
+ssl_select_cert_result_t
+select_certificate_cb(const SSL_CLIENT_HELLO *client_hello) {
+  auto ssl = client_hello->ssl;
+  auto anti_replay =
+      static_cast<AntiReplay *>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+  const uint8_t *data;
+  size_t datalen;
+
+  // Only a ClientHello which offers early data is worth remembering.
+  if (!SSL_early_callback_ctx_extension_get(
+          client_hello, TLSEXT_TYPE_early_data, &data, &datalen)) {
+    return ssl_select_cert_success;
+  }
+
+  if (anti_replay->check_and_insert(client_hello->random,
+                                    client_hello->random_len)) {
+    if (!config.quiet) {
+      std::cerr << "Replayed ClientHello detected; early data is rejected"
+                << std::endl;
+    }
+
+    SSL_set_early_data_enabled(ssl, 0);
+  }
+
+  return ssl_select_cert_success;
+}
+} // namespace
+
 namespace {
 int alpn_select_proto_h3_cb(SSL *ssl, const unsigned char **out,
                             unsigned char *outlen, const unsigned char *in,
@@ -210,11 +240,25 @@ int TLSServerContext::init(const char *private_key_file, const char *cert_file,
 
   SSL_CTX_set_options(ssl_ctx_, ssl_opts);
 
+  if (config.anti_replay) {
+    SSL_CTX_set_app_data(ssl_ctx_, &anti_replay_);
+    SSL_CTX_set_select_certificate_cb(ssl_ctx_, select_certificate_cb);
+  }
+
   if (SSL_CTX_set1_curves_list(ssl_ctx_, config.groups) != 1) {
     std::cerr << "SSL_CTX_set1_curves_list failed" << std::endl;
     return -1;
   }
 
+#ifdef HAVE_LIBBROTLI
+  if (!SSL_CTX_add_cert_compression_alg(
+          ssl_ctx_, ngtcp2::tls::CERTIFICATE_COMPRESSION_ALGO_BROTLI,
+          ngtcp2::tls::cert_compress, ngtcp2::tls::cert_decompress)) {
+    std::cerr << "SSL_CTX_add_cert_compression_alg failed" << std::endl;
+    return -1;
+  }
+#endif // HAVE_LIBBROTLI
+
   SSL_CTX_set_mode(ssl_ctx_, SSL_MODE_RELEASE_BUFFERS);
 
   if (ngtcp2_crypto_boringssl_configure_server_context(ssl_ctx_) != 0) {
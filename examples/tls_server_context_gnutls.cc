@@ -37,6 +37,21 @@ namespace {
 int anti_replay_db_add_func(void *dbf, time_t exp_time,
                             const gnutls_datum_t *key,
                             const gnutls_datum_t *data) {
+  if (!dbf) {
+    return 0;
+  }
+
+  auto anti_replay = static_cast<AntiReplay *>(dbf);
+
+  if (anti_replay->check_and_insert(key->data, key->size)) {
+    if (!config.quiet) {
+      std::cerr << "Replayed ClientHello detected; early data is rejected"
+                << std::endl;
+    }
+
+    return GNUTLS_E_DB_ENTRY_EXISTS;
+  }
+
   return 0;
 }
 } // namespace
@@ -68,6 +83,10 @@ gnutls_anti_replay_t TLSServerContext::get_anti_replay() const {
 
 int TLSServerContext::init(const char *private_key_file, const char *cert_file,
                            AppProtocol app_proto) {
+  if (config.anti_replay) {
+    gnutls_anti_replay_set_ptr(anti_replay_, &anti_replay_filter_);
+  }
+
   if (auto rv = gnutls_certificate_allocate_credentials(&cred_); rv != 0) {
     std::cerr << "gnutls_certificate_allocate_credentials failed: "
               << gnutls_strerror(rv) << std::endl;
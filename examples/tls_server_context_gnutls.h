@@ -32,6 +32,7 @@
 #include <gnutls/gnutls.h>
 
 #include "shared.h"
+#include "anti_replay.h"
 
 using namespace ngtcp2;
 
@@ -54,6 +55,9 @@ private:
   gnutls_certificate_credentials_t cred_;
   gnutls_datum_t session_ticket_key_;
   gnutls_anti_replay_t anti_replay_;
+  // anti_replay_filter_ is shared by all workers which use this
+  // context.  It backs anti_replay_ if config.anti_replay is true.
+  AntiReplay anti_replay_filter_;
 };
 
 #endif // TLS_SERVER_CONTEXT_GNUTLS_H
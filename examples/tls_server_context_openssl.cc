@@ -25,6 +25,7 @@
 #include "tls_server_context_openssl.h"
 
 #include <iostream>
+#include <array>
 #include <fstream>
 #include <limits>
 
@@ -186,6 +187,27 @@ int alpn_select_proto_perf_cb(SSL *ssl, const unsigned char **out,
 }
 } // namespace
 
+namespace {
+int allow_early_data_cb(SSL *ssl, void *arg) {
+  auto anti_replay = static_cast<AntiReplay *>(arg);
+  std::array<uint8_t, SSL3_RANDOM_SIZE> client_random;
+
+  SSL_get_client_random(ssl, client_random.data(), client_random.size());
+
+  if (anti_replay->check_and_insert(client_random.data(),
+                                    client_random.size())) {
+    if (!config.quiet) {
+      std::cerr << "Replayed ClientHello detected; early data is rejected"
+                << std::endl;
+    }
+
+    return 0;
+  }
+
+  return 1;
+}
+} // namespace
+
 namespace {
 int verify_cb(int preverify_ok, X509_STORE_CTX *ctx) {
   // We don't verify the client certificate.  Just request it for the
@@ -198,6 +220,11 @@ int TLSServerContext::init(const char *private_key_file, const char *cert_file,
                            AppProtocol app_proto) {
   constexpr static unsigned char sid_ctx[] = "ngtcp2 server";
 
+  if (ngtcp2_crypto_openssl_init() != 0) {
+    std::cerr << "ngtcp2_crypto_openssl_init failed" << std::endl;
+    return -1;
+  }
+
   ssl_ctx_ = SSL_CTX_new(TLS_server_method());
   if (!ssl_ctx_) {
     std::cerr << "SSSL_CTX_new: " << ERR_error_string(ERR_get_error(), nullptr)
@@ -220,6 +247,11 @@ int TLSServerContext::init(const char *private_key_file, const char *cert_file,
 
   SSL_CTX_set_options(ssl_ctx_, ssl_opts);
 
+  if (config.anti_replay) {
+    SSL_CTX_set_allow_early_data_cb(ssl_ctx_, allow_early_data_cb,
+                                    &anti_replay_);
+  }
+
   if (SSL_CTX_set_ciphersuites(ssl_ctx_, config.ciphers) != 1) {
     std::cerr << "SSL_CTX_set_ciphersuites: "
               << ERR_error_string(ERR_get_error(), nullptr) << std::endl;
@@ -266,6 +298,29 @@ int TLSServerContext::init(const char *private_key_file, const char *cert_file,
     return -1;
   }
 
+#if OPENSSL_VERSION_NUMBER >= 0x30200000L && !defined(OPENSSL_NO_COMP_ALG)
+  std::array<int, 3> cert_comp_algs{
+      TLSEXT_comp_cert_brotli,
+      TLSEXT_comp_cert_zstd,
+      TLSEXT_comp_cert_zlib,
+  };
+
+  if (SSL_CTX_set1_cert_comp_preference(ssl_ctx_, cert_comp_algs.data(),
+                                        cert_comp_algs.size()) != 1) {
+    std::cerr << "SSL_CTX_set1_cert_comp_preference failed" << std::endl;
+    return -1;
+  }
+
+  // Compress the certificate chain once, rather than in every
+  // handshake.
+  if (SSL_CTX_compress_certs(ssl_ctx_, 0) != 1) {
+    std::cerr << "SSL_CTX_compress_certs: "
+              << ERR_error_string(ERR_get_error(), nullptr) << std::endl;
+    return -1;
+  }
+#endif // OPENSSL_VERSION_NUMBER >= 0x30200000L &&
+       // !defined(OPENSSL_NO_COMP_ALG)
+
   SSL_CTX_set_session_id_context(ssl_ctx_, sid_ctx, sizeof(sid_ctx) - 1);
 
   if (config.verify_client) {
@@ -32,6 +32,7 @@
 #include <openssl/ssl.h>
 
 #include "shared.h"
+#include "anti_replay.h"
 
 using namespace ngtcp2;
 
@@ -49,6 +50,8 @@ public:
 
 private:
   SSL_CTX *ssl_ctx_;
+  // anti_replay_ is shared by all workers which use this context.
+  AntiReplay anti_replay_;
 };
 
 #endif // TLS_SERVER_CONTEXT_OPENSSL_H
@@ -174,6 +174,10 @@ TLSServerContext::TLSServerContext()
           .encrypt_ticket = &encrypt_ticket,
       },
       sign_cert_{}
+#ifdef HAVE_LIBBROTLI
+      ,
+      compressed_cert_{}
+#endif // HAVE_LIBBROTLI
 {}
 
 TLSServerContext::~TLSServerContext() {
@@ -181,6 +185,12 @@ TLSServerContext::~TLSServerContext() {
     ptls_openssl_dispose_sign_certificate(&sign_cert_);
   }
 
+#ifdef HAVE_LIBBROTLI
+  if (compressed_cert_.super.cb) {
+    ptls_dispose_compressed_certificate(&compressed_cert_);
+  }
+#endif // HAVE_LIBBROTLI
+
   for (size_t i = 0; i < ctx_.certificates.count; ++i) {
     free(ctx_.certificates.list[i].base);
   }
@@ -202,6 +212,19 @@ int TLSServerContext::init(const char *private_key_file, const char *cert_file,
     return -1;
   }
 
+#ifdef HAVE_LIBBROTLI
+  // The certificate chain is compressed once here.  picotls sends it
+  // uncompressed to a client which does not support brotli.
+  if (ptls_init_compressed_certificate(
+          &compressed_cert_, ctx_.certificates.list, ctx_.certificates.count,
+          ptls_iovec_init(nullptr, 0)) != 0) {
+    std::cerr << "ptls_init_compressed_certificate failed" << std::endl;
+    return -1;
+  }
+
+  ctx_.emit_certificate = &compressed_cert_.super;
+#endif // HAVE_LIBBROTLI
+
   if (load_private_key(private_key_file) != 0) {
     return -1;
   }
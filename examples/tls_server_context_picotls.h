@@ -31,6 +31,9 @@
 
 #include <picotls.h>
 #include <picotls/openssl.h>
+#ifdef HAVE_LIBBROTLI
+#  include <picotls/certificate_compression.h>
+#endif // HAVE_LIBBROTLI
 
 #include "shared.h"
 
@@ -54,6 +57,9 @@ private:
 
   ptls_context_t ctx_;
   ptls_openssl_sign_certificate_t sign_cert_;
+#ifdef HAVE_LIBBROTLI
+  ptls_emit_compressed_certificate_t compressed_cert_;
+#endif // HAVE_LIBBROTLI
 };
 
 #endif // TLS_SERVER_CONTEXT_PICOTLS_H
@@ -243,14 +243,6 @@ void hexdump(FILE *out, const uint8_t *src, size_t len) {
   }
 }
 
-std::string make_cid_key(const ngtcp2_cid *cid) {
-  return std::string(cid->data, cid->data + cid->datalen);
-}
-
-std::string make_cid_key(const uint8_t *cid, size_t cidlen) {
-  return std::string(cid, cid + cidlen);
-}
-
 std::string straddr(const sockaddr *sa, socklen_t salen) {
   std::array<char, NI_MAXHOST> host;
   std::array<char, NI_MAXSERV> port;
@@ -278,6 +270,8 @@ std::string_view strccalgo(ngtcp2_cc_algo cc_algo) {
     return "bbr"sv;
   case NGTCP2_CC_ALGO_BBR2:
     return "bbr2"sv;
+  case NGTCP2_CC_ALGO_PRAGUE:
+    return "prague"sv;
   default:
     assert(0);
     abort();
@@ -342,6 +336,33 @@ std::string format_duration(ngtcp2_duration n) {
   return format_uint(n) + "ns";
 }
 
+std::string format_http_date(time_t t) {
+  static constexpr char DAY_OF_WEEK[][4] = {"Sun", "Mon", "Tue", "Wed",
+                                            "Thu", "Fri", "Sat"};
+  static constexpr char MONTH[][4] = {"Jan", "Feb", "Mar", "Apr",
+                                      "May", "Jun", "Jul", "Aug",
+                                      "Sep", "Oct", "Nov", "Dec"};
+
+  struct tm tms;
+
+  if (gmtime_r(&t, &tms) == nullptr) {
+    return {};
+  }
+
+  // "Sun, 06 Nov 1994 08:49:37 GMT"
+  std::array<char, 64> buf;
+
+  auto rv = snprintf(buf.data(), buf.size(),
+                     "%s, %02d %s %04d %02d:%02d:%02d GMT",
+                     DAY_OF_WEEK[tms.tm_wday], tms.tm_mday, MONTH[tms.tm_mon],
+                     tms.tm_year + 1900, tms.tm_hour, tms.tm_min, tms.tm_sec);
+  if (rv < 0 || static_cast<size_t>(rv) >= buf.size()) {
+    return {};
+  }
+
+  return std::string(buf.data(), rv);
+}
+
 namespace {
 std::optional<std::pair<uint64_t, size_t>>
 parse_uint_internal(const std::string_view &s) {
@@ -475,6 +496,41 @@ std::optional<uint64_t> parse_duration(const std::string_view &s) {
   return res * m;
 }
 
+std::optional<std::vector<uint32_t>>
+parse_cpu_list(const std::string_view &s) {
+  constexpr uint64_t max_cpu = 65535;
+  std::vector<uint32_t> cpus;
+
+  for (auto first = std::begin(s);;) {
+    auto last = std::find(first, std::end(s), ',');
+    auto item = std::string_view{first, last};
+    auto dash = item.find('-');
+
+    auto lo = parse_uint(item.substr(0, dash));
+    if (!lo || *lo > max_cpu) {
+      return {};
+    }
+
+    auto hi = lo;
+    if (dash != std::string_view::npos) {
+      hi = parse_uint(item.substr(dash + 1));
+      if (!hi || *hi < *lo || *hi > max_cpu) {
+        return {};
+      }
+    }
+
+    for (auto cpu = *lo; cpu <= *hi; ++cpu) {
+      cpus.push_back(static_cast<uint32_t>(cpu));
+    }
+
+    if (last == std::end(s)) {
+      return cpus;
+    }
+
+    first = last + 1;
+  }
+}
+
 namespace {
 template <typename InputIt> InputIt eat_file(InputIt first, InputIt last) {
   if (first == last) {
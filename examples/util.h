@@ -37,6 +37,7 @@
 #include <random>
 #include <unordered_map>
 #include <string_view>
+#include <vector>
 
 #include <ngtcp2/ngtcp2.h>
 #include <nghttp3/nghttp3.h>
@@ -143,10 +144,6 @@ bool istarts_with_l(const T &a, const CharT (&b)[N]) {
   return istarts_with(a.begin(), a.end(), b, b + N - 1);
 }
 
-// make_cid_key returns the key for |cid|.
-std::string make_cid_key(const ngtcp2_cid *cid);
-std::string make_cid_key(const uint8_t *cid, size_t cidlen);
-
 // straddr stringifies |sa| of length |salen| in a format "[IP]:PORT".
 std::string straddr(const sockaddr *sa, socklen_t salen);
 
@@ -251,6 +248,29 @@ template <typename T> std::string format_uint_iec(T n) {
 // resolution.
 std::string format_duration(ngtcp2_duration n);
 
+// format_http_date formats |t| as IMF-fixdate defined in RFC 9110,
+// e.g., "Sun, 06 Nov 1994 08:49:37 GMT".
+std::string format_http_date(time_t t);
+
+// HTTPDateCache keeps the value of date header field, and formats it
+// again only when the second changes.
+class HTTPDateCache {
+public:
+  // get returns the value of date header field for |t|.
+  const std::string &get(time_t t) {
+    if (t != t_ || value_.empty()) {
+      t_ = t;
+      value_ = format_http_date(t);
+    }
+
+    return value_;
+  }
+
+private:
+  time_t t_{};
+  std::string value_;
+};
+
 // parse_uint parses |s| as 64-bit unsigned integer.  If it cannot
 // parse |s|, the return value does not contain a value.
 std::optional<uint64_t> parse_uint(const std::string_view &s);
@@ -266,6 +286,12 @@ std::optional<uint64_t> parse_uint_iec(const std::string_view &s);
 // the return value does not contain a value.
 std::optional<uint64_t> parse_duration(const std::string_view &s);
 
+// parse_cpu_list parses |s| as comma separated list of CPU numbers
+// and ranges, e.g., "0-3,8,10-11", and returns the CPUs in the order
+// they appear.  A CPU number must not exceed 65535.  If it cannot
+// parse |s|, the return value does not contain a value.
+std::optional<std::vector<uint32_t>> parse_cpu_list(const std::string_view &s);
+
 // generate_secure_random generates a cryptographically secure pseudo
 // random data of |datalen| bytes and stores to the buffer pointed by
 // |data|.
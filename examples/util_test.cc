@@ -75,6 +75,20 @@ void test_util_format_duration() {
   CU_ASSERT("61s" == util::format_duration(61000000000ull));
 }
 
+void test_util_format_http_date() {
+  CU_ASSERT("Thu, 01 Jan 1970 00:00:00 GMT" == util::format_http_date(0));
+  CU_ASSERT("Sun, 06 Nov 1994 08:49:37 GMT" ==
+            util::format_http_date(784111777));
+  CU_ASSERT("Tue, 19 Jan 2038 03:14:08 GMT" ==
+            util::format_http_date(2147483648ll));
+
+  util::HTTPDateCache cache;
+
+  CU_ASSERT("Sun, 06 Nov 1994 08:49:37 GMT" == cache.get(784111777));
+  CU_ASSERT("Sun, 06 Nov 1994 08:49:37 GMT" == cache.get(784111777));
+  CU_ASSERT("Sun, 06 Nov 1994 08:49:38 GMT" == cache.get(784111778));
+}
+
 void test_util_parse_uint() {
   {
     auto res = util::parse_uint("0");
@@ -219,6 +233,48 @@ void test_util_parse_duration() {
   }
 }
 
+void test_util_parse_cpu_list() {
+  {
+    auto res = util::parse_cpu_list("3");
+    CU_ASSERT(res.has_value());
+    CU_ASSERT((std::vector<uint32_t>{3} == *res));
+  }
+  {
+    auto res = util::parse_cpu_list("0-3,8,10-11");
+    CU_ASSERT(res.has_value());
+    CU_ASSERT((std::vector<uint32_t>{0, 1, 2, 3, 8, 10, 11} == *res));
+  }
+  {
+    auto res = util::parse_cpu_list("8,0-1");
+    CU_ASSERT(res.has_value());
+    CU_ASSERT((std::vector<uint32_t>{8, 0, 1} == *res));
+  }
+  {
+    auto res = util::parse_cpu_list("");
+    CU_ASSERT(!res.has_value());
+  }
+  {
+    auto res = util::parse_cpu_list("0,");
+    CU_ASSERT(!res.has_value());
+  }
+  {
+    auto res = util::parse_cpu_list("3-1");
+    CU_ASSERT(!res.has_value());
+  }
+  {
+    auto res = util::parse_cpu_list("1-");
+    CU_ASSERT(!res.has_value());
+  }
+  {
+    auto res = util::parse_cpu_list("a");
+    CU_ASSERT(!res.has_value());
+  }
+  {
+    auto res = util::parse_cpu_list("0-65536");
+    CU_ASSERT(!res.has_value());
+  }
+}
+
 void test_util_normalize_path() {
   CU_ASSERT("/" == util::normalize_path("/"));
   CU_ASSERT("/" == util::normalize_path("//"));
@@ -35,9 +35,11 @@ void test_util_format_durationf();
 void test_util_format_uint();
 void test_util_format_uint_iec();
 void test_util_format_duration();
+void test_util_format_http_date();
 void test_util_parse_uint();
 void test_util_parse_uint_iec();
 void test_util_parse_duration();
+void test_util_parse_cpu_list();
 void test_util_normalize_path();
 
 } // namespace ngtcp2
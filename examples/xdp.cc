@@ -0,0 +1,712 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "xdp.h"
+
+#ifdef HAVE_LIBBPF
+#  include <sys/mman.h>
+#  include <net/if.h>
+#  include <unistd.h>
+#  include <linux/if_link.h>
+#  include <linux/if_xdp.h>
+
+#  include <bpf/bpf.h>
+#  include <bpf/libbpf.h>
+#endif // HAVE_LIBBPF
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+namespace ngtcp2 {
+
+namespace xdp {
+
+namespace {
+constexpr uint16_t ETHERTYPE_IPV4 = 0x0800;
+constexpr uint16_t ETHERTYPE_IPV6 = 0x86dd;
+constexpr uint8_t IPPROTO_UDP_NUM = 17;
+constexpr uint8_t DEFAULT_TTL = 64;
+} // namespace
+
+namespace {
+uint16_t get_uint16(const uint8_t *p) {
+  return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+} // namespace
+
+namespace {
+uint8_t *put_uint16(uint8_t *p, uint16_t n) {
+  *p++ = static_cast<uint8_t>(n >> 8);
+  *p++ = static_cast<uint8_t>(n);
+  return p;
+}
+} // namespace
+
+namespace {
+// checksum_add adds |data| of length |len| to the one's complement
+// sum |sum| as a sequence of 16 bit big endian words.  |len| must be
+// even except for the last chunk.
+uint32_t checksum_add(uint32_t sum, const uint8_t *data, size_t len) {
+  for (; len > 1; data += 2, len -= 2) {
+    sum += get_uint16(data);
+  }
+
+  if (len) {
+    sum += static_cast<uint32_t>(*data << 8);
+  }
+
+  return sum;
+}
+} // namespace
+
+namespace {
+uint16_t checksum_fold(uint32_t sum) {
+  while (sum >> 16) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+
+  return static_cast<uint16_t>(~sum);
+}
+} // namespace
+
+int parse_udp_frame(FrameInfo &fi, const uint8_t *frame, size_t framelen) {
+  if (framelen < ETH_HDRLEN) {
+    return -1;
+  }
+
+  std::copy_n(frame, fi.dst_mac.size(), std::begin(fi.dst_mac));
+  std::copy_n(frame + 6, fi.src_mac.size(), std::begin(fi.src_mac));
+
+  auto ip = frame + ETH_HDRLEN;
+  auto iplen = framelen - ETH_HDRLEN;
+  const uint8_t *udp;
+  size_t udpmax;
+
+  fi.local_addr = {};
+  fi.remote_addr = {};
+
+  switch (get_uint16(frame + 12)) {
+  case ETHERTYPE_IPV4: {
+    if (iplen < IPV4_HDRLEN || (ip[0] >> 4) != 4) {
+      return -1;
+    }
+
+    size_t ihl = (ip[0] & 0xfu) * 4;
+    size_t totlen = get_uint16(ip + 2);
+
+    if (ihl < IPV4_HDRLEN || totlen > iplen || totlen < ihl + UDP_HDRLEN ||
+        (get_uint16(ip + 6) & 0x3fff) || ip[9] != IPPROTO_UDP_NUM) {
+      return -1;
+    }
+
+    fi.ecn = ip[1] & 0x3;
+
+    udp = ip + ihl;
+    udpmax = totlen - ihl;
+
+    auto &local = fi.local_addr.su.in;
+    local.sin_family = AF_INET;
+    memcpy(&local.sin_addr, ip + 16, sizeof(local.sin_addr));
+    memcpy(&local.sin_port, udp + 2, sizeof(local.sin_port));
+    fi.local_addr.len = sizeof(local);
+
+    auto &remote = fi.remote_addr.su.in;
+    remote.sin_family = AF_INET;
+    memcpy(&remote.sin_addr, ip + 12, sizeof(remote.sin_addr));
+    memcpy(&remote.sin_port, udp, sizeof(remote.sin_port));
+    fi.remote_addr.len = sizeof(remote);
+
+    break;
+  }
+  case ETHERTYPE_IPV6: {
+    if (iplen < IPV6_HDRLEN || (ip[0] >> 4) != 6) {
+      return -1;
+    }
+
+    size_t plen = get_uint16(ip + 4);
+
+    if (plen > iplen - IPV6_HDRLEN || plen < UDP_HDRLEN ||
+        ip[6] != IPPROTO_UDP_NUM) {
+      return -1;
+    }
+
+    fi.ecn = (ip[1] >> 4) & 0x3;
+
+    udp = ip + IPV6_HDRLEN;
+    udpmax = plen;
+
+    auto &local = fi.local_addr.su.in6;
+    local.sin6_family = AF_INET6;
+    memcpy(&local.sin6_addr, ip + 24, sizeof(local.sin6_addr));
+    memcpy(&local.sin6_port, udp + 2, sizeof(local.sin6_port));
+    fi.local_addr.len = sizeof(local);
+
+    auto &remote = fi.remote_addr.su.in6;
+    remote.sin6_family = AF_INET6;
+    memcpy(&remote.sin6_addr, ip + 8, sizeof(remote.sin6_addr));
+    memcpy(&remote.sin6_port, udp, sizeof(remote.sin6_port));
+    fi.remote_addr.len = sizeof(remote);
+
+    break;
+  }
+  default:
+    return -1;
+  }
+
+  size_t udplen = get_uint16(udp + 4);
+  if (udplen < UDP_HDRLEN || udplen > udpmax) {
+    return -1;
+  }
+
+  fi.payload_offset = static_cast<size_t>(udp - frame) + UDP_HDRLEN;
+  fi.payloadlen = udplen - UDP_HDRLEN;
+
+  return 0;
+}
+
+size_t udp_frame_hdrlen(int family) {
+  return ETH_HDRLEN + (family == AF_INET ? IPV4_HDRLEN : IPV6_HDRLEN) +
+         UDP_HDRLEN;
+}
+
+size_t write_udp_frame_header(uint8_t *frame, const MacAddr &src_mac,
+                              const MacAddr &dst_mac, const sockaddr *local,
+                              const sockaddr *remote, unsigned int ecn,
+                              size_t payloadlen) {
+  assert(local->sa_family == remote->sa_family);
+
+  auto udplen = static_cast<uint16_t>(UDP_HDRLEN + payloadlen);
+  auto p = std::copy(std::begin(dst_mac), std::end(dst_mac), frame);
+  p = std::copy(std::begin(src_mac), std::end(src_mac), p);
+
+  // The pseudo header sum of UDP checksum.
+  uint32_t sum = IPPROTO_UDP_NUM + udplen;
+  uint8_t *udp;
+
+  if (local->sa_family == AF_INET) {
+    auto &lin = *reinterpret_cast<const sockaddr_in *>(local);
+    auto &rin = *reinterpret_cast<const sockaddr_in *>(remote);
+
+    p = put_uint16(p, ETHERTYPE_IPV4);
+
+    auto ip = p;
+
+    *p++ = 0x45;
+    *p++ = static_cast<uint8_t>(ecn & 0x3);
+    p = put_uint16(p, static_cast<uint16_t>(IPV4_HDRLEN + udplen));
+    // Identification
+    p = put_uint16(p, 0);
+    // Don't Fragment
+    p = put_uint16(p, 0x4000);
+    *p++ = DEFAULT_TTL;
+    *p++ = IPPROTO_UDP_NUM;
+    // Header Checksum
+    p = put_uint16(p, 0);
+    p = std::copy_n(reinterpret_cast<const uint8_t *>(&lin.sin_addr),
+                    sizeof(lin.sin_addr), p);
+    p = std::copy_n(reinterpret_cast<const uint8_t *>(&rin.sin_addr),
+                    sizeof(rin.sin_addr), p);
+
+    put_uint16(ip + 10, checksum_fold(checksum_add(0, ip, IPV4_HDRLEN)));
+
+    sum = checksum_add(sum, ip + 12, 8);
+
+    udp = p;
+    memcpy(p, &lin.sin_port, sizeof(lin.sin_port));
+    memcpy(p + 2, &rin.sin_port, sizeof(rin.sin_port));
+  } else {
+    auto &lin6 = *reinterpret_cast<const sockaddr_in6 *>(local);
+    auto &rin6 = *reinterpret_cast<const sockaddr_in6 *>(remote);
+
+    p = put_uint16(p, ETHERTYPE_IPV6);
+
+    auto ip = p;
+
+    // Version, Traffic Class, and Flow Label
+    *p++ = 0x60;
+    *p++ = static_cast<uint8_t>((ecn & 0x3) << 4);
+    p = put_uint16(p, 0);
+    p = put_uint16(p, udplen);
+    *p++ = IPPROTO_UDP_NUM;
+    *p++ = DEFAULT_TTL;
+    p = std::copy_n(reinterpret_cast<const uint8_t *>(&lin6.sin6_addr),
+                    sizeof(lin6.sin6_addr), p);
+    p = std::copy_n(reinterpret_cast<const uint8_t *>(&rin6.sin6_addr),
+                    sizeof(rin6.sin6_addr), p);
+
+    sum = checksum_add(sum, ip + 8, 32);
+
+    udp = p;
+    memcpy(p, &lin6.sin6_port, sizeof(lin6.sin6_port));
+    memcpy(p + 2, &rin6.sin6_port, sizeof(rin6.sin6_port));
+  }
+
+  put_uint16(udp + 4, udplen);
+  put_uint16(udp + 6, 0);
+
+  auto csum = checksum_fold(checksum_add(sum, udp, udplen));
+  if (csum == 0) {
+    csum = 0xffff;
+  }
+
+  put_uint16(udp + 6, csum);
+
+  return static_cast<size_t>(udp - frame) + udplen;
+}
+
+namespace {
+// MAX_NEIGHBORS is the maximum number of MAC addresses remembered.
+// The table is cleared when it is reached, so that a flood of spoofed
+// source addresses does not grow it unboundedly.
+constexpr size_t MAX_NEIGHBORS = 65536;
+} // namespace
+
+namespace {
+std::string ip_key(const sockaddr *sa) {
+  if (sa->sa_family == AF_INET) {
+    auto &in = reinterpret_cast<const sockaddr_in *>(sa)->sin_addr;
+    return std::string(reinterpret_cast<const char *>(&in), sizeof(in));
+  }
+
+  auto &in6 = reinterpret_cast<const sockaddr_in6 *>(sa)->sin6_addr;
+  return std::string(reinterpret_cast<const char *>(&in6), sizeof(in6));
+}
+} // namespace
+
+NeighborTable::NeighborTable()
+    : local_mac_{}, gateway_mac_{}, learned_(false) {}
+
+void NeighborTable::learn(const FrameInfo &fi) {
+  local_mac_ = fi.dst_mac;
+  gateway_mac_ = fi.src_mac;
+  learned_ = true;
+
+  if (neighbors_.size() == MAX_NEIGHBORS) {
+    neighbors_.clear();
+  }
+
+  neighbors_[ip_key(&fi.remote_addr.su.sa)] = fi.src_mac;
+}
+
+const MacAddr *NeighborTable::find(const sockaddr *sa) const {
+  if (!learned_) {
+    return nullptr;
+  }
+
+  if (auto it = neighbors_.find(ip_key(sa)); it != std::end(neighbors_)) {
+    return &it->second;
+  }
+
+  return &gateway_mac_;
+}
+
+const MacAddr &NeighborTable::local_mac() const { return local_mac_; }
+
+} // namespace xdp
+
+#ifdef HAVE_LIBBPF
+#  ifndef AF_XDP
+#    define AF_XDP 44
+#  endif // !defined(AF_XDP)
+#  ifndef SOL_XDP
+#    define SOL_XDP 283
+#  endif // !defined(SOL_XDP)
+
+namespace {
+// xdp_ring_size is the number of entries of each ring.  The receive
+// and transmit frames are xdp_ring_size each.
+constexpr uint32_t xdp_ring_size = 2048;
+constexpr uint32_t xdp_nframes = xdp_ring_size * 2;
+constexpr uint32_t xdp_frame_size = 4096;
+} // namespace
+
+XdpProgram::XdpProgram()
+    : obj_(nullptr), xsks_map_fd_(-1), ifindex_(0), attached_(false) {}
+
+XdpProgram::~XdpProgram() {
+  if (attached_) {
+    bpf_xdp_detach(static_cast<int>(ifindex_), 0, nullptr);
+  }
+
+  if (obj_) {
+    bpf_object__close(obj_);
+  }
+}
+
+int XdpProgram::init(const char *path, const char *ifname, uint16_t port) {
+  ifindex_ = if_nametoindex(ifname);
+  if (ifindex_ == 0) {
+    std::cerr << "if_nametoindex: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  auto obj = bpf_object__open_file(path, nullptr);
+  if (libbpf_get_error(obj)) {
+    std::cerr << "bpf_object__open_file: Could not open " << path
+              << std::endl;
+    return -1;
+  }
+
+  obj_ = obj;
+
+  if (bpf_object__load(obj_) != 0) {
+    std::cerr << "bpf_object__load: Could not load " << path << std::endl;
+    return -1;
+  }
+
+  auto prog = bpf_object__find_program_by_name(obj_, "redirect_quic");
+  auto xsks_map = bpf_object__find_map_by_name(obj_, "xsks_map");
+  auto quic_port = bpf_object__find_map_by_name(obj_, "quic_port");
+  if (!prog || !xsks_map || !quic_port) {
+    std::cerr << "xdp-program: program or maps not found" << std::endl;
+    return -1;
+  }
+
+  uint32_t key = 0;
+  uint32_t val = port;
+  if (bpf_map_update_elem(bpf_map__fd(quic_port), &key, &val, BPF_ANY) != 0) {
+    std::cerr << "bpf_map_update_elem: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  xsks_map_fd_ = bpf_map__fd(xsks_map);
+
+  if (auto rv = bpf_xdp_attach(static_cast<int>(ifindex_),
+                               bpf_program__fd(prog),
+                               XDP_FLAGS_UPDATE_IF_NOEXIST, nullptr);
+      rv != 0) {
+    std::cerr << "bpf_xdp_attach: " << strerror(-rv) << std::endl;
+    return -1;
+  }
+
+  attached_ = true;
+
+  return 0;
+}
+
+bool XdpProgram::attached() const { return attached_; }
+
+uint32_t XdpProgram::ifindex() const { return ifindex_; }
+
+int XdpProgram::xsks_map_fd() const { return xsks_map_fd_; }
+
+namespace {
+int map_ring(XdpRing &r, int fd, const xdp_ring_offset &off, size_t entsize,
+             off_t pgoff) {
+  r.maplen = off.desc + xdp_ring_size * entsize;
+  r.map = mmap(nullptr, r.maplen, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, fd, pgoff);
+  if (r.map == MAP_FAILED) {
+    r.map = nullptr;
+    std::cerr << "mmap: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  auto base = static_cast<uint8_t *>(r.map);
+
+  r.producer = reinterpret_cast<uint32_t *>(base + off.producer);
+  r.consumer = reinterpret_cast<uint32_t *>(base + off.consumer);
+  r.flags = reinterpret_cast<uint32_t *>(base + off.flags);
+  r.desc = base + off.desc;
+  r.mask = xdp_ring_size - 1;
+
+  return 0;
+}
+} // namespace
+
+namespace {
+void unmap_ring(XdpRing &r) {
+  if (r.map) {
+    munmap(r.map, r.maplen);
+  }
+}
+} // namespace
+
+XdpSocket::XdpSocket()
+    : fd_(-1),
+      ifindex_(0),
+      umem_(nullptr),
+      umemlen_(0),
+      fill_{},
+      comp_{},
+      rx_{},
+      tx_{} {}
+
+XdpSocket::~XdpSocket() {
+  unmap_ring(fill_);
+  unmap_ring(comp_);
+  unmap_ring(rx_);
+  unmap_ring(tx_);
+
+  // Closing the socket removes it from the map of XdpProgram.
+  if (fd_ != -1) {
+    close(fd_);
+  }
+
+  if (umem_) {
+    munmap(umem_, umemlen_);
+  }
+}
+
+int XdpSocket::init(const XdpProgram &prog, uint32_t queue_id) {
+  ifindex_ = prog.ifindex();
+
+  fd_ = socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0);
+  if (fd_ == -1) {
+    std::cerr << "socket: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  umemlen_ = static_cast<size_t>(xdp_nframes) * xdp_frame_size;
+
+  auto umem = mmap(nullptr, umemlen_, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+  if (umem == MAP_FAILED) {
+    std::cerr << "mmap: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  umem_ = static_cast<uint8_t *>(umem);
+
+  xdp_umem_reg mr{};
+  mr.addr = reinterpret_cast<uintptr_t>(umem_);
+  mr.len = umemlen_;
+  mr.chunk_size = xdp_frame_size;
+
+  if (setsockopt(fd_, SOL_XDP, XDP_UMEM_REG, &mr, sizeof(mr)) != 0) {
+    std::cerr << "setsockopt: XDP_UMEM_REG: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  for (auto opt : {XDP_UMEM_FILL_RING, XDP_UMEM_COMPLETION_RING, XDP_RX_RING,
+                   XDP_TX_RING}) {
+    auto n = xdp_ring_size;
+
+    if (setsockopt(fd_, SOL_XDP, opt, &n, sizeof(n)) != 0) {
+      std::cerr << "setsockopt: " << strerror(errno) << std::endl;
+      return -1;
+    }
+  }
+
+  xdp_mmap_offsets off;
+  socklen_t optlen = sizeof(off);
+
+  if (getsockopt(fd_, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) != 0) {
+    std::cerr << "getsockopt: XDP_MMAP_OFFSETS: " << strerror(errno)
+              << std::endl;
+    return -1;
+  }
+
+  if (map_ring(fill_, fd_, off.fr, sizeof(uint64_t),
+               XDP_UMEM_PGOFF_FILL_RING) != 0 ||
+      map_ring(comp_, fd_, off.cr, sizeof(uint64_t),
+               XDP_UMEM_PGOFF_COMPLETION_RING) != 0 ||
+      map_ring(rx_, fd_, off.rx, sizeof(xdp_desc), XDP_PGOFF_RX_RING) != 0 ||
+      map_ring(tx_, fd_, off.tx, sizeof(xdp_desc), XDP_PGOFF_TX_RING) != 0) {
+    return -1;
+  }
+
+  sockaddr_xdp sxdp{};
+  sxdp.sxdp_family = AF_XDP;
+  sxdp.sxdp_ifindex = ifindex_;
+  sxdp.sxdp_queue_id = queue_id;
+  sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP;
+
+  if (bind(fd_, reinterpret_cast<sockaddr *>(&sxdp), sizeof(sxdp)) != 0) {
+    std::cerr << "bind: AF_XDP queue " << queue_id << ": " << strerror(errno)
+              << std::endl;
+    return -1;
+  }
+
+  // The first half of UMEM receives frames.
+  auto addrs = static_cast<uint64_t *>(fill_.desc);
+
+  for (uint32_t i = 0; i < xdp_ring_size; ++i) {
+    addrs[i] = static_cast<uint64_t>(i) * xdp_frame_size;
+  }
+
+  __atomic_store_n(fill_.producer, xdp_ring_size, __ATOMIC_RELEASE);
+
+  free_tx_.reserve(xdp_ring_size);
+
+  for (auto i = xdp_ring_size; i < xdp_nframes; ++i) {
+    free_tx_.push_back(static_cast<uint64_t>(i) * xdp_frame_size);
+  }
+
+  uint32_t val = static_cast<uint32_t>(fd_);
+  if (bpf_map_update_elem(prog.xsks_map_fd(), &queue_id, &val, BPF_ANY) !=
+      0) {
+    std::cerr << "bpf_map_update_elem: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+int XdpSocket::fd() const { return fd_; }
+
+uint32_t XdpSocket::ifindex() const { return ifindex_; }
+
+size_t XdpSocket::read(
+    const std::function<void(const xdp::FrameInfo &, uint8_t *)> &f,
+    size_t max) {
+  auto cons = *rx_.consumer;
+  auto n = std::min(
+      static_cast<size_t>(__atomic_load_n(rx_.producer, __ATOMIC_ACQUIRE) -
+                          cons),
+      max);
+
+  if (n == 0) {
+    return 0;
+  }
+
+  auto descs = static_cast<const xdp_desc *>(rx_.desc);
+  auto addrs = static_cast<uint64_t *>(fill_.desc);
+  auto prod = *fill_.producer;
+
+  for (size_t i = 0; i < n; ++i) {
+    auto &d = descs[(cons + i) & rx_.mask];
+    auto frame = umem_ + d.addr;
+    xdp::FrameInfo fi;
+
+    if (xdp::parse_udp_frame(fi, frame, d.len) == 0) {
+      fi.local_addr.ifindex = ifindex_;
+      fi.remote_addr.ifindex = ifindex_;
+
+      neighbors_.learn(fi);
+
+      f(fi, frame + fi.payload_offset);
+    }
+
+    // The frame goes back to the kernel.  The fill ring always has
+    // room for it because it is as large as the receive frames.
+    addrs[(prod + i) & fill_.mask] =
+        d.addr & ~static_cast<uint64_t>(xdp_frame_size - 1);
+  }
+
+  __atomic_store_n(rx_.consumer, cons + n, __ATOMIC_RELEASE);
+  __atomic_store_n(fill_.producer, prod + n, __ATOMIC_RELEASE);
+
+  return n;
+}
+
+std::pair<size_t, int> XdpSocket::send(const ngtcp2_addr &local_addr,
+                                       const ngtcp2_addr &remote_addr,
+                                       unsigned int ecn, const uint8_t *data,
+                                       size_t datalen, size_t gso_size) {
+  auto mac = neighbors_.find(remote_addr.addr);
+  if (!mac) {
+    return {datalen, NETWORK_ERR_OK};
+  }
+
+  auto hdrlen = xdp::udp_frame_hdrlen(local_addr.addr->sa_family);
+  auto descs = static_cast<xdp_desc *>(tx_.desc);
+  auto prod = *tx_.producer;
+  uint32_t n = 0;
+  size_t nsent = 0;
+
+  reclaim();
+
+  for (auto p = data, end = data + datalen; p != end;) {
+    auto len = std::min(gso_size, static_cast<size_t>(end - p));
+
+    if (hdrlen + len > xdp_frame_size) {
+      // Too large to fit in a frame.
+      p += len;
+      nsent += len;
+
+      continue;
+    }
+
+    if (free_tx_.empty()) {
+      // Transmit the frames written so far, and wait for some of them
+      // to complete.
+      __atomic_store_n(tx_.producer, prod + n, __ATOMIC_RELEASE);
+      kick();
+      reclaim();
+
+      if (free_tx_.empty()) {
+        break;
+      }
+    }
+
+    auto addr = free_tx_.back();
+    free_tx_.pop_back();
+
+    auto frame = umem_ + addr;
+
+    memcpy(frame + hdrlen, p, len);
+
+    auto &d = descs[(prod + n) & tx_.mask];
+    d.addr = addr;
+    d.len = static_cast<uint32_t>(
+        xdp::write_udp_frame_header(frame, neighbors_.local_mac(), *mac,
+                                    local_addr.addr, remote_addr.addr, ecn,
+                                    len));
+    d.options = 0;
+
+    ++n;
+    p += len;
+    nsent += len;
+  }
+
+  if (n) {
+    __atomic_store_n(tx_.producer, prod + n, __ATOMIC_RELEASE);
+    kick();
+  }
+
+  if (nsent < datalen) {
+    return {nsent, NETWORK_ERR_SEND_BLOCKED};
+  }
+
+  return {nsent, NETWORK_ERR_OK};
+}
+
+void XdpSocket::reclaim() {
+  auto cons = *comp_.consumer;
+  auto prod = __atomic_load_n(comp_.producer, __ATOMIC_ACQUIRE);
+  auto addrs = static_cast<const uint64_t *>(comp_.desc);
+
+  for (; cons != prod; ++cons) {
+    free_tx_.push_back(addrs[cons & comp_.mask]);
+  }
+
+  __atomic_store_n(comp_.consumer, cons, __ATOMIC_RELEASE);
+}
+
+void XdpSocket::kick() {
+  if (!(__atomic_load_n(tx_.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP)) {
+    return;
+  }
+
+  // EAGAIN, EBUSY, and ENOBUFS are transient.  The frames are sent in
+  // the next kick.
+  sendto(fd_, nullptr, 0, MSG_DONTWAIT, nullptr, 0);
+}
+#endif // HAVE_LIBBPF
+
+} // namespace ngtcp2
@@ -0,0 +1,223 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef XDP_H
+#define XDP_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <cstdint>
+#include <array>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <ngtcp2/ngtcp2.h>
+
+#include "network.h"
+
+#ifdef HAVE_LIBBPF
+struct bpf_object;
+#endif // HAVE_LIBBPF
+
+namespace ngtcp2 {
+
+namespace xdp {
+
+using MacAddr = std::array<uint8_t, 6>;
+
+constexpr size_t ETH_HDRLEN = 14;
+constexpr size_t IPV4_HDRLEN = 20;
+constexpr size_t IPV6_HDRLEN = 40;
+constexpr size_t UDP_HDRLEN = 8;
+
+// FrameInfo is the result of parse_udp_frame.
+struct FrameInfo {
+  MacAddr src_mac;
+  MacAddr dst_mac;
+  // local_addr is the destination address and port of the datagram.
+  Address local_addr;
+  // remote_addr is the source address and port of the datagram.
+  Address remote_addr;
+  unsigned int ecn;
+  // payload_offset is the offset to UDP payload from the beginning
+  // of the frame.
+  size_t payload_offset;
+  size_t payloadlen;
+};
+
+// parse_udp_frame parses Ethernet frame |frame| of length |framelen|
+// which carries an IPv4 or IPv6 UDP datagram, and stores the result
+// in |fi|.  ifindex of the addresses is left 0.  IP fragments, IP
+// options other than IPv4 header options, and VLAN tags are not
+// supported.  UDP checksum is not verified.  It returns 0 if it
+// succeeds, or -1.
+int parse_udp_frame(FrameInfo &fi, const uint8_t *frame, size_t framelen);
+
+// udp_frame_hdrlen returns the length of Ethernet, IP, and UDP
+// headers of a frame of address |family|.
+size_t udp_frame_hdrlen(int family);
+
+// write_udp_frame_header writes Ethernet, IP, and UDP headers of a
+// datagram from |local| to |remote| into the beginning of |frame|.
+// The UDP payload of length |payloadlen| must be already placed at
+// |frame| + udp_frame_hdrlen(local->sa_family), so that the checksum
+// is calculated over it.  |local| and |remote| must be of the same
+// address family.  It returns the length of the frame.
+size_t write_udp_frame_header(uint8_t *frame, const MacAddr &src_mac,
+                              const MacAddr &dst_mac, const sockaddr *local,
+                              const sockaddr *remote, unsigned int ecn,
+                              size_t payloadlen);
+
+// NeighborTable remembers the MAC addresses seen in the received
+// frames.  A datagram to a remote address is sent to the MAC address
+// which the frames from that address came from, or to the source MAC
+// address of the last received frame if the address has not been
+// seen, which is usually the gateway.
+class NeighborTable {
+public:
+  NeighborTable();
+
+  // learn remembers the MAC addresses of the remote endpoint and this
+  // host in |fi|.
+  void learn(const FrameInfo &fi);
+  // find returns the MAC address of the next hop toward |sa|, or
+  // nullptr if no frame has been received yet.
+  const MacAddr *find(const sockaddr *sa) const;
+  // local_mac returns the destination MAC address of the last
+  // received frame.
+  const MacAddr &local_mac() const;
+
+private:
+  MacAddr local_mac_;
+  MacAddr gateway_mac_;
+  bool learned_;
+  // neighbors_ maps the raw bytes of IP address to the MAC address of
+  // the frames received from it.
+  std::unordered_map<std::string, MacAddr> neighbors_;
+};
+
+} // namespace xdp
+
+#ifdef HAVE_LIBBPF
+// XdpProgram loads the XDP program in bpf/xdp_kern.o, and attaches it
+// to a network interface.  The program redirects the UDP datagrams to
+// the QUIC port to the AF_XDP sockets, and passes the other packets
+// to the kernel.  It is detached when XdpProgram is destroyed.
+class XdpProgram {
+public:
+  XdpProgram();
+  ~XdpProgram();
+
+  // init loads the object file |path|, attaches its program to the
+  // interface |ifname|, and makes it redirect the datagrams to UDP
+  // |port|.
+  int init(const char *path, const char *ifname, uint16_t port);
+  bool attached() const;
+  uint32_t ifindex() const;
+  // xsks_map_fd returns the file descriptor of the map from receive
+  // queue index to AF_XDP socket.
+  int xsks_map_fd() const;
+
+private:
+  bpf_object *obj_;
+  int xsks_map_fd_;
+  uint32_t ifindex_;
+  bool attached_;
+};
+
+// XdpRing is a single producer, single consumer ring shared with the
+// kernel.
+struct XdpRing {
+  uint32_t *producer;
+  uint32_t *consumer;
+  uint32_t *flags;
+  void *desc;
+  uint32_t mask;
+  void *map;
+  size_t maplen;
+};
+
+// XdpSocket is an AF_XDP socket bound to a receive queue of the
+// interface that XdpProgram is attached to.  Its UMEM is split in
+// half: the first half is handed to the kernel through the fill ring
+// to receive frames, and the other half is used to transmit frames.
+// Each transmitted datagram is copied into a frame after the space
+// for the headers.
+class XdpSocket {
+public:
+  XdpSocket();
+  ~XdpSocket();
+
+  // init creates AF_XDP socket bound to |queue_id| of the interface
+  // of |prog|, and registers it to |prog|.
+  int init(const XdpProgram &prog, uint32_t queue_id);
+  int fd() const;
+  uint32_t ifindex() const;
+  // read calls |f| for each UDP datagram received, up to |max|
+  // datagrams.  The payload passed to |f| is in UMEM, and is valid
+  // until |f| returns.  It returns the number of frames consumed.
+  size_t read(
+      const std::function<void(const xdp::FrameInfo &, uint8_t *)> &f,
+      size_t max);
+  // send sends |data| of length |datalen| which is a batch of UDP
+  // datagrams each of which is |gso_size| bytes long except for the
+  // last one.  It returns the number of bytes sent, and
+  // NETWORK_ERR_OK, or NETWORK_ERR_SEND_BLOCKED if there is no frame
+  // or transmit descriptor available.  The datagram to a remote
+  // address whose MAC address is unknown is dropped.
+  std::pair<size_t, int> send(const ngtcp2_addr &local_addr,
+                              const ngtcp2_addr &remote_addr,
+                              unsigned int ecn, const uint8_t *data,
+                              size_t datalen, size_t gso_size);
+
+private:
+  // reclaim moves the frames whose transmission has completed back to
+  // free_tx_.
+  void reclaim();
+  // kick wakes up the kernel to transmit frames if it needs to.
+  void kick();
+
+  int fd_;
+  uint32_t ifindex_;
+  uint8_t *umem_;
+  size_t umemlen_;
+  XdpRing fill_;
+  XdpRing comp_;
+  XdpRing rx_;
+  XdpRing tx_;
+  // free_tx_ is the UMEM addresses of the frames which can be used
+  // for transmission.
+  std::vector<uint64_t> free_tx_;
+  xdp::NeighborTable neighbors_;
+};
+#endif // HAVE_LIBBPF
+
+} // namespace ngtcp2
+
+#endif // XDP_H
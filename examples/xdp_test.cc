@@ -0,0 +1,244 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "xdp_test.h"
+
+#include <cstring>
+#include <array>
+
+#include <CUnit/CUnit.h>
+
+#include "xdp.h"
+
+namespace ngtcp2 {
+
+namespace {
+const xdp::MacAddr src_mac{0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+const xdp::MacAddr dst_mac{0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+} // namespace
+
+namespace {
+// udp_checksum_ok returns true if the UDP checksum of |udp| of
+// length |udplen| is valid.  |pseudo| is the source and destination
+// addresses of length |pseudolen|.
+bool udp_checksum_ok(const uint8_t *pseudo, size_t pseudolen,
+                     const uint8_t *udp, size_t udplen) {
+  uint32_t sum = 17 + static_cast<uint32_t>(udplen);
+
+  for (size_t i = 0; i < pseudolen; i += 2) {
+    sum += static_cast<uint32_t>(pseudo[i] << 8 | pseudo[i + 1]);
+  }
+
+  for (size_t i = 0; i < udplen; i += 2) {
+    sum += static_cast<uint32_t>(udp[i] << 8);
+    if (i + 1 < udplen) {
+      sum += udp[i + 1];
+    }
+  }
+
+  while (sum >> 16) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+
+  return sum == 0xffff;
+}
+} // namespace
+
+void test_xdp_udp_frame_ipv4() {
+  std::array<uint8_t, 256> frame{};
+  sockaddr_in local{}, remote{};
+
+  local.sin_family = AF_INET;
+  local.sin_addr.s_addr = htonl(0xc0a80001);
+  local.sin_port = htons(443);
+  remote.sin_family = AF_INET;
+  remote.sin_addr.s_addr = htonl(0xc0a800c7);
+  remote.sin_port = htons(50000);
+
+  // The total length is 115 so that the header checksum can be
+  // compared with the well known example 0xb861 whose TOS is 0.
+  // ECT(0) lowers it by 2.
+  auto hdrlen = xdp::udp_frame_hdrlen(AF_INET);
+  size_t payloadlen = 87;
+
+  CU_ASSERT(42 == hdrlen);
+
+  for (size_t i = 0; i < payloadlen; ++i) {
+    frame[hdrlen + i] = static_cast<uint8_t>(i);
+  }
+
+  auto framelen = xdp::write_udp_frame_header(
+      frame.data(), src_mac, dst_mac, reinterpret_cast<sockaddr *>(&local),
+      reinterpret_cast<sockaddr *>(&remote), 0x2, payloadlen);
+
+  CU_ASSERT(hdrlen + payloadlen == framelen);
+  CU_ASSERT(0 == memcmp(dst_mac.data(), frame.data(), 6));
+  CU_ASSERT(0x08 == frame[12] && 0x00 == frame[13]);
+  CU_ASSERT(0x02 == frame[15]);
+  CU_ASSERT(0xb8 == frame[24] && 0x5f == frame[25]);
+  CU_ASSERT(udp_checksum_ok(frame.data() + 26, 8, frame.data() + 34,
+                            8 + payloadlen));
+
+  xdp::FrameInfo fi;
+
+  // The frame received by the peer.
+  CU_ASSERT(0 == xdp::parse_udp_frame(fi, frame.data(), framelen));
+  CU_ASSERT(src_mac == fi.src_mac);
+  CU_ASSERT(dst_mac == fi.dst_mac);
+  CU_ASSERT(sizeof(sockaddr_in) == fi.local_addr.len);
+  CU_ASSERT(remote.sin_addr.s_addr == fi.local_addr.su.in.sin_addr.s_addr);
+  CU_ASSERT(remote.sin_port == fi.local_addr.su.in.sin_port);
+  CU_ASSERT(local.sin_addr.s_addr == fi.remote_addr.su.in.sin_addr.s_addr);
+  CU_ASSERT(local.sin_port == fi.remote_addr.su.in.sin_port);
+  CU_ASSERT(0x2 == fi.ecn);
+  CU_ASSERT(hdrlen == fi.payload_offset);
+  CU_ASSERT(payloadlen == fi.payloadlen);
+
+  // Trailing bytes, e.g., Ethernet padding, are ignored.
+  CU_ASSERT(0 == xdp::parse_udp_frame(fi, frame.data(), framelen + 10));
+  CU_ASSERT(payloadlen == fi.payloadlen);
+}
+
+void test_xdp_udp_frame_ipv6() {
+  std::array<uint8_t, 256> frame{};
+  sockaddr_in6 local{}, remote{};
+
+  local.sin6_family = AF_INET6;
+  local.sin6_addr.s6_addr[0] = 0x20;
+  local.sin6_addr.s6_addr[1] = 0x01;
+  local.sin6_addr.s6_addr[15] = 0x01;
+  local.sin6_port = htons(443);
+  remote.sin6_family = AF_INET6;
+  remote.sin6_addr.s6_addr[0] = 0x20;
+  remote.sin6_addr.s6_addr[1] = 0x01;
+  remote.sin6_addr.s6_addr[15] = 0x02;
+  remote.sin6_port = htons(50000);
+
+  auto hdrlen = xdp::udp_frame_hdrlen(AF_INET6);
+  // Odd length exercises the padding of the checksum.
+  size_t payloadlen = 101;
+
+  CU_ASSERT(62 == hdrlen);
+
+  for (size_t i = 0; i < payloadlen; ++i) {
+    frame[hdrlen + i] = static_cast<uint8_t>(0xff - i);
+  }
+
+  auto framelen = xdp::write_udp_frame_header(
+      frame.data(), src_mac, dst_mac, reinterpret_cast<sockaddr *>(&local),
+      reinterpret_cast<sockaddr *>(&remote), 0x3, payloadlen);
+
+  CU_ASSERT(hdrlen + payloadlen == framelen);
+  CU_ASSERT(0x86 == frame[12] && 0xdd == frame[13]);
+  CU_ASSERT(udp_checksum_ok(frame.data() + 22, 32, frame.data() + 54,
+                            8 + payloadlen));
+
+  xdp::FrameInfo fi;
+
+  CU_ASSERT(0 == xdp::parse_udp_frame(fi, frame.data(), framelen));
+  CU_ASSERT(sizeof(sockaddr_in6) == fi.local_addr.len);
+  CU_ASSERT(0 == memcmp(&remote.sin6_addr, &fi.local_addr.su.in6.sin6_addr,
+                        sizeof(remote.sin6_addr)));
+  CU_ASSERT(0 == memcmp(&local.sin6_addr, &fi.remote_addr.su.in6.sin6_addr,
+                        sizeof(local.sin6_addr)));
+  CU_ASSERT(local.sin6_port == fi.remote_addr.su.in6.sin6_port);
+  CU_ASSERT(0x3 == fi.ecn);
+  CU_ASSERT(hdrlen == fi.payload_offset);
+  CU_ASSERT(payloadlen == fi.payloadlen);
+  CU_ASSERT(0 == memcmp(frame.data() + hdrlen, frame.data() + fi.payload_offset,
+                        payloadlen));
+}
+
+void test_xdp_parse_udp_frame_invalid() {
+  std::array<uint8_t, 256> frame{};
+  sockaddr_in local{}, remote{};
+  xdp::FrameInfo fi;
+
+  local.sin_family = AF_INET;
+  remote.sin_family = AF_INET;
+
+  auto framelen = xdp::write_udp_frame_header(
+      frame.data(), src_mac, dst_mac, reinterpret_cast<sockaddr *>(&local),
+      reinterpret_cast<sockaddr *>(&remote), 0, 10);
+
+  // Truncated frame
+  CU_ASSERT(-1 == xdp::parse_udp_frame(fi, frame.data(), 13));
+  CU_ASSERT(-1 == xdp::parse_udp_frame(fi, frame.data(), framelen - 1));
+
+  // Fragment
+  frame[20] = 0x20;
+
+  CU_ASSERT(-1 == xdp::parse_udp_frame(fi, frame.data(), framelen));
+
+  frame[20] = 0x40;
+
+  // Not UDP
+  frame[23] = 6;
+
+  CU_ASSERT(-1 == xdp::parse_udp_frame(fi, frame.data(), framelen));
+
+  frame[23] = 17;
+
+  // VLAN tagged
+  frame[12] = 0x81;
+
+  CU_ASSERT(-1 == xdp::parse_udp_frame(fi, frame.data(), framelen));
+}
+
+void test_xdp_neighbor_table() {
+  xdp::NeighborTable nt;
+  xdp::FrameInfo fi{};
+  sockaddr_in known{}, unknown{};
+  const xdp::MacAddr gateway_mac{0x02, 0x00, 0x00, 0x00, 0x00, 0x03};
+
+  known.sin_family = AF_INET;
+  known.sin_addr.s_addr = htonl(0xc0a800c7);
+  unknown.sin_family = AF_INET;
+  unknown.sin_addr.s_addr = htonl(0xc0a800c8);
+
+  CU_ASSERT(nullptr == nt.find(reinterpret_cast<sockaddr *>(&known)));
+
+  fi.src_mac = src_mac;
+  fi.dst_mac = dst_mac;
+  memcpy(&fi.remote_addr.su.in, &known, sizeof(known));
+  fi.remote_addr.len = sizeof(known);
+
+  nt.learn(fi);
+
+  CU_ASSERT(dst_mac == nt.local_mac());
+  CU_ASSERT(src_mac == *nt.find(reinterpret_cast<sockaddr *>(&known)));
+  CU_ASSERT(src_mac == *nt.find(reinterpret_cast<sockaddr *>(&unknown)));
+
+  // A frame from another address through the gateway changes the
+  // default, but the known address keeps its own MAC address.
+  fi.src_mac = gateway_mac;
+  fi.remote_addr.su.in.sin_addr.s_addr = htonl(0x08080808);
+
+  nt.learn(fi);
+
+  CU_ASSERT(src_mac == *nt.find(reinterpret_cast<sockaddr *>(&known)));
+  CU_ASSERT(gateway_mac == *nt.find(reinterpret_cast<sockaddr *>(&unknown)));
+}
+
+} // namespace ngtcp2
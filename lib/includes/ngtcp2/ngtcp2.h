@@ -214,6 +214,16 @@ typedef struct ngtcp2_mem {
   ngtcp2_realloc realloc;
 } ngtcp2_mem;
 
+/**
+ * @struct
+ *
+ * :type:`ngtcp2_thread_arena` is an opaque, unsynchronized memory
+ * allocator which serves the small allocations of a single thread
+ * from the per size class free lists.  See
+ * `ngtcp2_thread_arena_new`.
+ */
+typedef struct ngtcp2_thread_arena ngtcp2_thread_arena;
+
 /**
  * @macrosection
  *
@@ -526,7 +536,9 @@ typedef struct ngtcp2_mem {
 #define NGTCP2_ECN_MASK 0x3
 
 #define NGTCP2_PKT_INFO_VERSION_V1 1
-#define NGTCP2_PKT_INFO_VERSION NGTCP2_PKT_INFO_VERSION_V1
+#define NGTCP2_PKT_INFO_VERSION_V2 2
+#define NGTCP2_PKT_INFO_VERSION_V3 3
+#define NGTCP2_PKT_INFO_VERSION NGTCP2_PKT_INFO_VERSION_V3
 
 /**
  * @struct
@@ -541,6 +553,77 @@ typedef struct NGTCP2_ALIGN(8) ngtcp2_pkt_info {
    * :macro:`NGTCP2_ECN_ECT_0`, or :macro:`NGTCP2_ECN_CE`.
    */
   uint32_t ecn;
+  /* The following fields have been added since
+     NGTCP2_PKT_INFO_VERSION_V2. */
+  /**
+   * :member:`tx_ts` is the intended departure time of the packet
+   * written by the packet writing functions (e.g.,
+   * `ngtcp2_conn_writev_stream`).  It is computed from the pacing
+   * rate of the congestion controller and the amount of data written
+   * since the last call of `ngtcp2_conn_update_pkt_tx_time`.  The
+   * application can pass it to a rate limiter, SO_TXTIME, or NIC
+   * offload so that the packet is not sent before this time.  It is
+   * never less than the timestamp passed to the writing function.
+   * If pacing is not in effect, it is equal to that timestamp.  This
+   * field is ignored by `ngtcp2_conn_read_pkt`.
+   *
+   * This field is available since :macro:`NGTCP2_PKT_INFO_VERSION_V2`.
+   */
+  uint64_t tx_ts;
+  /* The following fields have been added since
+     NGTCP2_PKT_INFO_VERSION_V3. */
+  /**
+   * :member:`offload_key_id` is the identifier of the key which
+   * protects the unprotected 1RTT packet.  It is the same value that
+   * is passed to :member:`ngtcp2_callbacks.offload_tx_key` when the
+   * key is installed.  This field is only meaningful if
+   * :member:`offload_pktlen` is nonzero.
+   *
+   * This field is available since :macro:`NGTCP2_PKT_INFO_VERSION_V3`.
+   */
+  uint64_t offload_key_id;
+  /**
+   * :member:`offload_pkt_num` is the full packet number of the
+   * unprotected 1RTT packet, which is used to construct AEAD nonce.
+   * This field is only meaningful if :member:`offload_pktlen` is
+   * nonzero.
+   *
+   * This field is available since :macro:`NGTCP2_PKT_INFO_VERSION_V3`.
+   */
+  int64_t offload_pkt_num;
+  /**
+   * :member:`offload_pktlen` is nonzero if the packet writing
+   * function left 1RTT packet unprotected because
+   * :member:`ngtcp2_settings.crypto_offload` is enabled.  In that
+   * case, it is the length of the packet, which is always the last
+   * packet in the UDP datagram.  Its payload is not encrypted, and
+   * the last AEAD tag length bytes are reserved for the tag.  Header
+   * protection is not applied either.  The packet must be protected
+   * by a NIC or a kernel before it is sent.  The packet writing
+   * functions set this field to 0 if they do not leave any packet
+   * unprotected.  This field is ignored by `ngtcp2_conn_read_pkt`.
+   *
+   * This field is available since :macro:`NGTCP2_PKT_INFO_VERSION_V3`.
+   */
+  uint16_t offload_pktlen;
+  /**
+   * :member:`offload_hdlen` is the length of the header of the
+   * unprotected 1RTT packet including the packet number, which is
+   * used as AEAD associated data.  This field is only meaningful if
+   * :member:`offload_pktlen` is nonzero.
+   *
+   * This field is available since :macro:`NGTCP2_PKT_INFO_VERSION_V3`.
+   */
+  uint16_t offload_hdlen;
+  /**
+   * :member:`offload_pkt_numlen` is the length of the packet number
+   * field of the unprotected 1RTT packet, which ends at
+   * :member:`offload_hdlen`.  This field is only meaningful if
+   * :member:`offload_pktlen` is nonzero.
+   *
+   * This field is available since :macro:`NGTCP2_PKT_INFO_VERSION_V3`.
+   */
+  uint8_t offload_pkt_numlen;
 } ngtcp2_pkt_info;
 
 /**
@@ -870,6 +953,14 @@ typedef struct NGTCP2_ALIGN(8) ngtcp2_pkt_info {
  */
 #define NGTCP2_PKT_FLAG_KEY_PHASE 0x04u
 
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_PKT_FLAG_SPIN_BIT` indicates Latency Spin Bit set.
+ * It is only used for 1RTT packet.
+ */
+#define NGTCP2_PKT_FLAG_SPIN_BIT 0x08u
+
 /**
  * @enum
  *
@@ -1525,8 +1616,55 @@ typedef struct ngtcp2_transport_params {
    * this field.
    */
   uint8_t version_info_present;
+  /**
+   * :member:`min_ack_delay` is the minimum acknowledgement delay that
+   * the sender can delay acknowledgements by.  If it is nonzero, the
+   * sender supports ACK_FREQUENCY and IMMEDIATE_ACK frames of
+   * "Acknowledgement Frequency" extension.  See
+   * https://datatracker.ietf.org/doc/html/draft-ietf-quic-ack-frequency.
+   * It must not exceed :member:`max_ack_delay`, and it must be less
+   * than 2^24 microseconds.  The resolution is microsecond.
+   */
+  ngtcp2_duration min_ack_delay;
+  /**
+   * :member:`fec_window` is the number of bytes of the most recently
+   * received data that the endpoint retains per stream in order to
+   * recover lost STREAM frames from REPAIR frames of the experimental
+   * forward error correction extension.  If it is nonzero, the
+   * endpoint supports the extension.  The extension is used only if both
+   * endpoints advertise it.  See `ngtcp2_conn_set_stream_fec`.
+   */
+  uint64_t fec_window;
 } ngtcp2_transport_params;
 
+/**
+ * @struct
+ *
+ * :type:`ngtcp2_transport_params_template` holds the encoded form of
+ * the QUIC transport parameters which do not depend on a particular
+ * connection.  Server which accepts many connections with the same
+ * configuration can initialize it once with
+ * `ngtcp2_transport_params_template_init`, and set it to
+ * :member:`ngtcp2_settings.transport_params_template` to avoid
+ * encoding them for each connection.
+ */
+typedef struct ngtcp2_transport_params_template {
+  /**
+   * :member:`params` is the copy of the transport parameters which
+   * this template was created from.  The encoded data is used only
+   * if the local transport parameters of a connection match them.
+   */
+  ngtcp2_transport_params params;
+  /**
+   * :member:`data` is the encoded transport parameters.
+   */
+  uint8_t data[256];
+  /**
+   * :member:`datalen` is the length of :member:`data`.
+   */
+  size_t datalen;
+} ngtcp2_transport_params_template;
+
 /**
  * @enum
  *
@@ -1564,6 +1702,80 @@ typedef enum ngtcp2_pktns_id {
  * :type:`ngtcp2_conn_stat` holds various connection statistics, and
  * computed data for recovery and congestion controller.
  */
+/**
+ * @enum
+ *
+ * :type:`ngtcp2_ss_exit_reason` is the reason why the initial slow
+ * start of Reno, CUBIC, and Prague ended.
+ */
+typedef enum ngtcp2_ss_exit_reason {
+  /**
+   * :enum:`NGTCP2_SS_EXIT_REASON_NONE` indicates that the initial
+   * slow start has not ended yet.
+   */
+  NGTCP2_SS_EXIT_REASON_NONE,
+  /**
+   * :enum:`NGTCP2_SS_EXIT_REASON_LOSS` indicates that the initial
+   * slow start ended due to a congestion event.
+   */
+  NGTCP2_SS_EXIT_REASON_LOSS,
+  /**
+   * :enum:`NGTCP2_SS_EXIT_REASON_HYSTART` indicates that HyStart++
+   * ended the initial slow start after Conservative Slow Start did
+   * not find the increase of RTT spurious.
+   */
+  NGTCP2_SS_EXIT_REASON_HYSTART
+} ngtcp2_ss_exit_reason;
+
+/**
+ * @enum
+ *
+ * :type:`ngtcp2_bbr2_state` is the state of BBR v2 congestion
+ * controller.
+ */
+typedef enum ngtcp2_bbr2_state {
+  /**
+   * :enum:`NGTCP2_BBR2_STATE_NONE` indicates that BBR v2 is not in
+   * use.
+   */
+  NGTCP2_BBR2_STATE_NONE,
+  /**
+   * :enum:`NGTCP2_BBR2_STATE_STARTUP` is Startup state.
+   */
+  NGTCP2_BBR2_STATE_STARTUP,
+  /**
+   * :enum:`NGTCP2_BBR2_STATE_DRAIN` is Drain state.
+   */
+  NGTCP2_BBR2_STATE_DRAIN,
+  /**
+   * :enum:`NGTCP2_BBR2_STATE_PROBE_BW_DOWN` is ProbeBW_DOWN phase.
+   */
+  NGTCP2_BBR2_STATE_PROBE_BW_DOWN,
+  /**
+   * :enum:`NGTCP2_BBR2_STATE_PROBE_BW_CRUISE` is ProbeBW_CRUISE
+   * phase.
+   */
+  NGTCP2_BBR2_STATE_PROBE_BW_CRUISE,
+  /**
+   * :enum:`NGTCP2_BBR2_STATE_PROBE_BW_REFILL` is ProbeBW_REFILL
+   * phase.
+   */
+  NGTCP2_BBR2_STATE_PROBE_BW_REFILL,
+  /**
+   * :enum:`NGTCP2_BBR2_STATE_PROBE_BW_UP` is ProbeBW_UP phase.
+   */
+  NGTCP2_BBR2_STATE_PROBE_BW_UP,
+  /**
+   * :enum:`NGTCP2_BBR2_STATE_PROBE_RTT` is ProbeRTT state.
+   */
+  NGTCP2_BBR2_STATE_PROBE_RTT,
+  /**
+   * :enum:`NGTCP2_BBR2_STATE_MAX` is defined to get the number of
+   * states.
+   */
+  NGTCP2_BBR2_STATE_MAX
+} ngtcp2_bbr2_state;
+
 typedef struct ngtcp2_conn_stat {
   /**
    * :member:`latest_rtt` is the latest RTT sample which is not
@@ -1651,1751 +1863,3282 @@ typedef struct ngtcp2_conn_stat {
    * scheduled and transmitted together.
    */
   size_t send_quantum;
+  /**
+   * :member:`ss_exit_reason` is the reason why the initial slow start
+   * ended.  Only Reno, CUBIC, and Prague set this field.
+   */
+  ngtcp2_ss_exit_reason ss_exit_reason;
+  /**
+   * :member:`ss_exit_ts` is the timestamp when the initial slow start
+   * ended.  It is UINT64_MAX if it has not ended.
+   */
+  ngtcp2_tstamp ss_exit_ts;
+  /**
+   * :member:`ss_exit_cwnd` is the congestion window when the initial
+   * slow start ended, before it is reduced by a congestion event.
+   */
+  uint64_t ss_exit_cwnd;
+  /**
+   * :member:`hystart_css_count` is the number of times HyStart++
+   * entered Conservative Slow Start because RTT increased.
+   */
+  size_t hystart_css_count;
+  /**
+   * :member:`hystart_css_spurious_count` is the number of times
+   * HyStart++ resumed slow start from Conservative Slow Start because
+   * the increase of RTT turned out to be spurious.
+   */
+  size_t hystart_css_spurious_count;
+  /**
+   * :member:`bbr2_state` is the current state of BBR v2.  It is
+   * :enum:`ngtcp2_bbr2_state.NGTCP2_BBR2_STATE_NONE` unless BBR v2 is
+   * used.  The following bbr2_* fields are only set by BBR v2, and
+   * they are updated when an acknowledgement is received, a packet is
+   * sent or lost, and BBR v2 is reset.
+   */
+  ngtcp2_bbr2_state bbr2_state;
+  /**
+   * :member:`bbr2_state_time` is the total time spent in each state,
+   * indexed by :type:`ngtcp2_bbr2_state`.
+   */
+  ngtcp2_duration bbr2_state_time[NGTCP2_BBR2_STATE_MAX];
+  /**
+   * :member:`bbr2_state_count` is the number of times each state,
+   * indexed by :type:`ngtcp2_bbr2_state`, was entered.
+   */
+  uint64_t bbr2_state_count[NGTCP2_BBR2_STATE_MAX];
+  /**
+   * :member:`bbr2_max_bw` is the estimated maximum bandwidth in
+   * bytes per second.
+   */
+  uint64_t bbr2_max_bw;
+  /**
+   * :member:`bbr2_bw_lo` is the short-term lower bound of bandwidth
+   * in bytes per second.  UINT64_MAX means no bound.
+   */
+  uint64_t bbr2_bw_lo;
+  /**
+   * :member:`bbr2_inflight_hi` is the long-term upper bound of
+   * inflight data in bytes.  UINT64_MAX means no bound.
+   */
+  uint64_t bbr2_inflight_hi;
+  /**
+   * :member:`bbr2_inflight_lo` is the short-term lower bound of
+   * inflight data in bytes.  UINT64_MAX means no bound.
+   */
+  uint64_t bbr2_inflight_lo;
+  /**
+   * :member:`bbr2_inflight_too_high_count` is the number of times
+   * the loss rate of a round exceeded the threshold, which lowers
+   * :member:`bbr2_inflight_hi` and ends bandwidth probing.
+   */
+  uint64_t bbr2_inflight_too_high_count;
+  /**
+   * :member:`spurious_loss_count` is the number of packets which were
+   * declared lost, and acknowledged later.  Their contents have been
+   * retransmitted needlessly.
+   */
+  uint64_t spurious_loss_count;
+  /**
+   * :member:`spurious_congestion_count` is the number of times all
+   * packets declared lost were acknowledged later, and the
+   * congestion controller was asked to undo the reduction of the
+   * congestion window.
+   */
+  uint64_t spurious_congestion_count;
+  /**
+   * :member:`fec_recovered_count` is the number of lost STREAM frames
+   * which were recovered from REPAIR frames without waiting for
+   * their retransmission.
+   */
+  uint64_t fec_recovered_count;
+  /**
+   * :member:`handshake_datagrams_sent` is the number of UDP datagrams
+   * sent which contain Initial or Handshake packet.  It tells how
+   * well the handshake packets are coalesced.
+   */
+  uint64_t handshake_datagrams_sent;
+  /**
+   * :member:`lost_pkt_count` is the number of packets which were
+   * declared lost.  PMTUD probe packets are not counted.
+   */
+  uint64_t lost_pkt_count;
+  /**
+   * :member:`decrypt_failure_count` is the number of received
+   * packets which were discarded because their payload could not be
+   * decrypted.
+   */
+  uint64_t decrypt_failure_count;
+  /**
+   * :member:`undecryptable_pkt_buffered_count` is the number of
+   * received packets which were buffered because the keys to
+   * decrypt them were not available yet.
+   */
+  uint64_t undecryptable_pkt_buffered_count;
+  /**
+   * :member:`undecryptable_pkt_dropped_count` is the number of
+   * received packets which could not be decrypted yet, and were
+   * dropped because the buffer for them was full.
+   */
+  uint64_t undecryptable_pkt_dropped_count;
+  /**
+   * :member:`amplification_limited_count` is the number of times
+   * that a server could not send Initial or Handshake packets
+   * because of the amplification limit on an unvalidated path.
+   */
+  uint64_t amplification_limited_count;
+  /**
+   * :member:`amplification_limited_duration` is the total time that
+   * a server spent waiting for the client to send more bytes so that
+   * the amplification limit allowed it to send the pending Initial or
+   * Handshake packets.  A server which validates the client address
+   * with the token sent in NEW_TOKEN frame (see
+   * :member:`ngtcp2_settings.token`) is not limited, and does not
+   * wait.
+   */
+  ngtcp2_duration amplification_limited_duration;
 } ngtcp2_conn_stat;
 
+#define NGTCP2_MEM_STAT_VERSION_V1 1
+#define NGTCP2_MEM_STAT_VERSION NGTCP2_MEM_STAT_VERSION_V1
+
 /**
- * @enum
+ * @struct
  *
- * :type:`ngtcp2_cc_algo` defines congestion control algorithms.
+ * :type:`ngtcp2_mem_stat` holds the number of bytes currently
+ * allocated by a connection, broken down by the internal subsystem
+ * which owns them.  The bytes are counted as requested from
+ * :type:`ngtcp2_mem`, and do not include the allocator overhead.
+ * The memory is only counted if :member:`ngtcp2_settings.mem_budget`
+ * is nonzero.  Otherwise, all fields are 0.
  */
-typedef enum ngtcp2_cc_algo {
+typedef struct ngtcp2_mem_stat {
   /**
-   * :enum:`NGTCP2_CC_ALGO_RENO` represents Reno.
+   * :member:`total` is the number of bytes allocated by the
+   * connection in total.  It includes the memory which is not
+   * attributed to any of the subsystems listed below, but does not
+   * include :type:`ngtcp2_conn` object itself.
    */
-  NGTCP2_CC_ALGO_RENO = 0x00,
+  uint64_t total;
   /**
-   * :enum:`NGTCP2_CC_ALGO_CUBIC` represents Cubic.
+   * :member:`peak` is the largest value that :member:`total` has
+   * ever reached.
    */
-  NGTCP2_CC_ALGO_CUBIC = 0x01,
+  uint64_t peak;
   /**
-   * :enum:`NGTCP2_CC_ALGO_BBR` represents BBR.  If BBR is chosen,
-   * packet pacing is enabled.
+   * :member:`ksl` is the number of bytes allocated for the blocks
+   * of the sorted containers, excluding those owned by the other
+   * subsystems.
    */
-  NGTCP2_CC_ALGO_BBR = 0x02,
+  uint64_t ksl;
   /**
-   * :enum:`NGTCP2_CC_ALGO_BBR2` represents BBR v2.  If BBR v2 is
-   * chosen, packet pacing is enabled.
+   * :member:`rob` is the number of bytes allocated to buffer out of
+   * order stream data.
    */
-  NGTCP2_CC_ALGO_BBR2 = 0x03
-} ngtcp2_cc_algo;
+  uint64_t rob;
+  /**
+   * :member:`balloc` is the number of bytes allocated by the block
+   * allocators that back the connection's object pools, e.g., the
+   * frame chains and the retransmission buffer entries.
+   */
+  uint64_t balloc;
+  /**
+   * :member:`crypto` is the number of bytes allocated to send,
+   * retransmit, and reassemble CRYPTO data.
+   */
+  uint64_t crypto;
+  /**
+   * :member:`dgram` is the number of bytes allocated to queue
+   * DATAGRAM frames with `ngtcp2_conn_enqueue_datagram`.
+   */
+  uint64_t dgram;
+  /**
+   * :member:`other` is the number of bytes allocated that are not
+   * counted in any of the above.
+   */
+  uint64_t other;
+} ngtcp2_mem_stat;
+
+#define NGTCP2_SHARED_POOL_STAT_VERSION_V1 1
+#define NGTCP2_SHARED_POOL_STAT_VERSION NGTCP2_SHARED_POOL_STAT_VERSION_V1
 
 /**
- * @functypedef
+ * @struct
  *
- * :type:`ngtcp2_printf` is a callback function for logging.
- * |user_data| is the same object passed to `ngtcp2_conn_client_new`
- * or `ngtcp2_conn_server_new`.
+ * :type:`ngtcp2_shared_pool_stat` holds the statistics of
+ * :type:`ngtcp2_shared_pool`.  The numbers are the sum over all kinds
+ * of objects in the pool.
  */
-typedef void (*ngtcp2_printf)(void *user_data, const char *format, ...);
+typedef struct ngtcp2_shared_pool_stat {
+  /**
+   * :member:`in_use` is the number of objects that the connections
+   * currently use.
+   */
+  uint64_t in_use;
+  /**
+   * :member:`cached` is the number of released objects that the pool
+   * keeps for reuse.
+   */
+  uint64_t cached;
+  /**
+   * :member:`reused` is the number of allocations served by the
+   * released objects.
+   */
+  uint64_t reused;
+  /**
+   * :member:`allocated` is the number of allocations served by the
+   * memory allocator.
+   */
+  uint64_t allocated;
+} ngtcp2_shared_pool_stat;
+
+#define NGTCP2_PERF_STAT_VERSION_V1 1
+#define NGTCP2_PERF_STAT_VERSION NGTCP2_PERF_STAT_VERSION_V1
 
 /**
- * @macrosection
+ * @struct
  *
- * QLog related macros
+ * :type:`ngtcp2_perf_stat` holds the CPU time, in nanoseconds, that
+ * a connection has spent in each processing phase of
+ * `ngtcp2_conn_read_pkt` and `ngtcp2_conn_write_pkt` (and the other
+ * functions which write packets).  The phases do not overlap: for
+ * example, the time spent in congestion control while processing an
+ * ACK frame is counted in :member:`cc`, and not in :member:`ack`.
+ * The time is measured only if the library is built with
+ * ``--enable-perf-stat`` (or ``-DENABLE_PERF_STAT=ON`` with CMake),
+ * and :member:`ngtcp2_settings.perf_stat` is nonzero.  Otherwise,
+ * all fields are 0.
  */
+typedef struct ngtcp2_perf_stat {
+  /**
+   * :member:`decrypt` is the time spent to remove header protection
+   * and decrypt packets.
+   */
+  uint64_t decrypt;
+  /**
+   * :member:`frame_decode` is the time spent to decode frames.
+   */
+  uint64_t frame_decode;
+  /**
+   * :member:`ack` is the time spent to process ACK frames, excluding
+   * loss detection and congestion control.
+   */
+  uint64_t ack;
+  /**
+   * :member:`loss_detection` is the time spent to detect lost
+   * packets, including the expiry of the loss detection timer.
+   */
+  uint64_t loss_detection;
+  /**
+   * :member:`cc` is the time spent in the congestion controller.
+   */
+  uint64_t cc;
+  /**
+   * :member:`encrypt` is the time spent to encrypt packets and apply
+   * header protection.
+   */
+  uint64_t encrypt;
+  /**
+   * :member:`other` is the rest of the time spent in
+   * `ngtcp2_conn_read_pkt` and `ngtcp2_conn_write_pkt`, e.g., to
+   * handle stream data and to build packets.
+   */
+  uint64_t other;
+} ngtcp2_perf_stat;
+
+#define NGTCP2_STALL_STAT_VERSION_V1 1
+#define NGTCP2_STALL_STAT_VERSION NGTCP2_STALL_STAT_VERSION_V1
 
 /**
- * @macro
+ * @struct
  *
- * :macro:`NGTCP2_QLOG_WRITE_FLAG_NONE` indicates no flag set.
+ * :type:`ngtcp2_stall_stat` holds the time, in nanoseconds, during
+ * which a connection could not send packets, broken down by the
+ * reason.  The reason is determined each time the application calls
+ * `ngtcp2_conn_writev_stream`, `ngtcp2_conn_write_pkt`, or the other
+ * functions which write packets, and it is assumed to hold until the
+ * next call.  The time during which packets are sent is not counted.
+ * The fields are updated on each of those calls, therefore they do
+ * not include the time elapsed since the last call.
  */
-#define NGTCP2_QLOG_WRITE_FLAG_NONE 0x00u
+typedef struct ngtcp2_stall_stat {
+  /**
+   * :member:`cwnd` is the time limited by congestion window.
+   */
+  ngtcp2_duration cwnd;
+  /**
+   * :member:`pacing` is the time limited by packet pacing.
+   */
+  ngtcp2_duration pacing;
+  /**
+   * :member:`conn_flow_control` is the time limited by
+   * connection-level flow control.
+   */
+  ngtcp2_duration conn_flow_control;
+  /**
+   * :member:`stream_flow_control` is the time limited by
+   * stream-level flow control of the stream that application tried
+   * to write.
+   */
+  ngtcp2_duration stream_flow_control;
+  /**
+   * :member:`app` is the time limited by application, that is, it
+   * had nothing to send.
+   */
+  ngtcp2_duration app;
+} ngtcp2_stall_stat;
+
 /**
  * @macro
  *
- * :macro:`NGTCP2_QLOG_WRITE_FLAG_FIN` indicates that this is the
- * final call to :type:`ngtcp2_qlog_write` in the current connection.
+ * :macro:`NGTCP2_LATENCY_HIST_NBUCKET` is the number of buckets in
+ * :type:`ngtcp2_latency_hist`.
  */
-#define NGTCP2_QLOG_WRITE_FLAG_FIN 0x01u
+#define NGTCP2_LATENCY_HIST_NBUCKET 256
 
 /**
  * @struct
  *
- * :type:`ngtcp2_rand_ctx` is a wrapper around native random number
- * generator.  It is opaque to the ngtcp2 library.  This might be
- * useful if application needs to specify random number generator per
- * thread or per connection.
+ * :type:`ngtcp2_latency_hist` is a histogram of durations in
+ * nanoseconds.  The buckets are log-linear: each power of 2 is split
+ * into 8 buckets of the same width, so that a bucket is at most 12.5%
+ * wider than its lower bound, and durations less than 8 nanoseconds
+ * have their own bucket.  The last bucket also counts all durations
+ * longer than about 17 seconds.  Use `ngtcp2_latency_hist_bucket_lower`
+ * to get the lower bound of a bucket, and
+ * `ngtcp2_latency_hist_percentile` to estimate a percentile.
  */
-typedef struct ngtcp2_rand_ctx {
+typedef struct ngtcp2_latency_hist {
   /**
-   * :member:`native_handle` is a pointer to an underlying random
-   * number generator.
+   * :member:`count` is the number of samples.
    */
-  void *native_handle;
-} ngtcp2_rand_ctx;
+  uint64_t count;
+  /**
+   * :member:`sum` is the sum of the samples.
+   */
+  ngtcp2_duration sum;
+  /**
+   * :member:`max` is the largest sample.
+   */
+  ngtcp2_duration max;
+  /**
+   * :member:`buckets` is the number of samples in each bucket.
+   */
+  uint64_t buckets[NGTCP2_LATENCY_HIST_NBUCKET];
+} ngtcp2_latency_hist;
 
-/**
- * @functypedef
- *
- * :type:`ngtcp2_qlog_write` is a callback function which is called to
- * write qlog |data| of length |datalen| bytes.  |flags| is bitwise OR
- * of zero or more of :macro:`NGTCP2_QLOG_WRITE_FLAG_*
- * <NGTCP2_QLOG_WRITE_FLAG_NONE>`.  If
- * :macro:`NGTCP2_QLOG_WRITE_FLAG_FIN` is set, |datalen| may be 0.
- */
-typedef void (*ngtcp2_qlog_write)(void *user_data, uint32_t flags,
-                                  const void *data, size_t datalen);
+#define NGTCP2_LATENCY_STAT_VERSION_V1 1
+#define NGTCP2_LATENCY_STAT_VERSION NGTCP2_LATENCY_STAT_VERSION_V1
 
 /**
  * @struct
  *
- * :type:`ngtcp2_qlog_settings` is a set of settings for qlog.
+ * :type:`ngtcp2_latency_stat` holds the histograms of the delays
+ * which a connection adds between the network and an application.
+ * They are recorded only if :member:`ngtcp2_settings.latency_stat` is
+ * nonzero.  Otherwise, all fields are 0.
  */
-typedef struct ngtcp2_qlog_settings {
+typedef struct ngtcp2_latency_stat {
   /**
-   * :member:`odcid` is Original Destination Connection ID sent by
-   * client.  It is used as group_id and ODCID fields.  Client ignores
-   * this field and uses dcid parameter passed to
-   * `ngtcp2_conn_client_new()`.
+   * :member:`recv_to_app` is the time from the receipt of a packet
+   * until its stream data are passed to
+   * :member:`ngtcp2_callbacks.recv_stream_data`.  A sample is taken
+   * per callback.  Stream data received in order are delivered
+   * immediately unless the packet was buffered waiting for keys.
+   * Data received out of order wait for the missing data, and the
+   * sample is the time since the first data buffered behind the gap
+   * was received, which makes head-of-line blocking visible.
    */
-  ngtcp2_cid odcid;
+  ngtcp2_latency_hist recv_to_app;
   /**
-   * :member:`write` is a callback function to write qlog.  Setting
-   * ``NULL`` disables qlog.
+   * :member:`ack_delay` is the time from the receipt of the first
+   * ack-eliciting packet which is not acknowledged yet until an ACK
+   * frame is sent for it.
    */
-  ngtcp2_qlog_write write;
-} ngtcp2_qlog_settings;
+  ngtcp2_latency_hist ack_delay;
+  /**
+   * :member:`write_to_send` is the time from when an application
+   * first offers stream data to `ngtcp2_conn_writev_stream` (or the
+   * other functions which write stream data) until the data are
+   * packed into a packet for the first time.  A sample is taken per
+   * STREAM frame which carries new data.  Data which are not sent
+   * because of flow control, congestion control, or a full packet
+   * are offered again by the application, and they are counted from
+   * the first offer.
+   */
+  ngtcp2_latency_hist write_to_send;
+} ngtcp2_latency_stat;
 
-#define NGTCP2_SETTINGS_VERSION_V1 1
-#define NGTCP2_SETTINGS_VERSION NGTCP2_SETTINGS_VERSION_V1
+#define NGTCP2_HOL_STAT_VERSION_V1 1
+#define NGTCP2_HOL_STAT_VERSION NGTCP2_HOL_STAT_VERSION_V1
 
 /**
  * @struct
  *
- * :type:`ngtcp2_settings` defines QUIC connection settings.
+ * :type:`ngtcp2_hol_stat` holds the statistics of head-of-line
+ * blocking of incoming stream data.  A stream is blocked from the
+ * time when it receives data beyond a gap until the time when the
+ * gap is filled and no data remain buffered behind the next gap.
+ * The blocking which has not been resolved yet is not counted.
  */
-typedef struct ngtcp2_settings {
+typedef struct ngtcp2_hol_stat {
   /**
-   * :member:`qlog` is qlog settings.
+   * :member:`nblocked` is the number of times that a stream was
+   * blocked.
    */
-  ngtcp2_qlog_settings qlog;
+  uint64_t nblocked;
   /**
-   * :member:`cc_algo` specifies congestion control algorithm.
+   * :member:`blocked_bytes` is the number of bytes of stream data
+   * which were buffered behind a gap before they were delivered to
+   * the application.
    */
-  ngtcp2_cc_algo cc_algo;
+  uint64_t blocked_bytes;
   /**
-   * :member:`initial_ts` is an initial timestamp given to the
-   * library.
+   * :member:`blocked_duration` is the total time, in nanoseconds,
+   * during which a stream was blocked.
    */
-  ngtcp2_tstamp initial_ts;
+  ngtcp2_duration blocked_duration;
+} ngtcp2_hol_stat;
+
+/**
+ * @enum
+ *
+ * :type:`ngtcp2_cc_algo` defines congestion control algorithms.
+ */
+typedef enum ngtcp2_cc_algo {
   /**
-   * :member:`initial_rtt` is an initial RTT.
+   * :enum:`NGTCP2_CC_ALGO_RENO` represents Reno.
    */
-  ngtcp2_duration initial_rtt;
+  NGTCP2_CC_ALGO_RENO = 0x00,
   /**
-   * :member:`log_printf` is a function that the library uses to write
-   * logs.  ``NULL`` means no logging output.  It is nothing to do
-   * with qlog.
+   * :enum:`NGTCP2_CC_ALGO_CUBIC` represents Cubic.
    */
-  ngtcp2_printf log_printf;
+  NGTCP2_CC_ALGO_CUBIC = 0x01,
   /**
-   * :member:`max_udp_payload_size` is the maximum size of UDP
-   * datagram payload that this endpoint transmits.  It is used by
-   * congestion controller to compute congestion window.
+   * :enum:`NGTCP2_CC_ALGO_BBR` represents BBR.  If BBR is chosen,
+   * packet pacing is enabled.
    */
-  size_t max_udp_payload_size;
+  NGTCP2_CC_ALGO_BBR = 0x02,
   /**
-   * :member:`token` is a token from Retry packet or NEW_TOKEN frame.
-   *
-   * Server sets this field if it received the token in Client Initial
-   * packet and successfully validated.
-   *
-   * Client sets this field if it intends to send token in its Initial
-   * packet.
-   *
-   * `ngtcp2_conn_server_new` and `ngtcp2_conn_client_new` make a copy
-   * of token.
+   * :enum:`NGTCP2_CC_ALGO_BBR2` represents BBR v2.  If BBR v2 is
+   * chosen, packet pacing is enabled.
    */
-  ngtcp2_vec token;
+  NGTCP2_CC_ALGO_BBR2 = 0x03,
   /**
-   * :member:`rand_ctx` is an optional random number generator to be
-   * passed to :type:`ngtcp2_rand` callback.
+   * :enum:`NGTCP2_CC_ALGO_PRAGUE` represents Prague, the L4S
+   * congestion control.  If Prague is chosen, packets are sent with
+   * ECT(1) marking, and cwnd is reduced in proportion to the
+   * fraction of CE marked packets.  It behaves like Reno otherwise.
    */
-  ngtcp2_rand_ctx rand_ctx;
+  NGTCP2_CC_ALGO_PRAGUE = 0x04
+} ngtcp2_cc_algo;
+
+/**
+ * @enum
+ *
+ * :type:`ngtcp2_sched_policy` defines the policies which decide the
+ * order in which the streams scheduled by
+ * `ngtcp2_conn_schedule_stream` send data.  It also orders the
+ * retransmission of stream data.
+ */
+typedef enum ngtcp2_sched_policy {
   /**
-   * :member:`max_window` is the maximum connection-level flow control
-   * window if connection-level window auto-tuning is enabled.  The
-   * connection-level window auto tuning is enabled if nonzero value
-   * is specified in this field.  The initial value of window size is
-   * :member:`ngtcp2_transport_params.initial_max_data`.  The window
-   * size is scaled up to the value specified in this field.
+   * :enum:`NGTCP2_SCHED_POLICY_ROUND_ROBIN` makes the streams take
+   * turns, one STREAM frame per turn.
    */
-  uint64_t max_window;
+  NGTCP2_SCHED_POLICY_ROUND_ROBIN = 0x00,
   /**
-   * :member:`max_stream_window` is the maximum stream-level flow
-   * control window if stream-level window auto-tuning is enabled.
-   * The stream-level window auto-tuning is enabled if nonzero value
-   * is specified in this field.  The initial value of window size is
-   * :member:`ngtcp2_transport_params.initial_max_stream_data_bidi_remote`,
-   * :member:`ngtcp2_transport_params.initial_max_stream_data_bidi_local`,
-   * or :member:`ngtcp2_transport_params.initial_max_stream_data_uni`,
-   * depending on the type of stream.  The window size is scaled up to
-   * the value specified in this field.
+   * :enum:`NGTCP2_SCHED_POLICY_WEIGHTED_FAIR` makes the streams share
+   * the bandwidth in proportion to
+   * :member:`ngtcp2_stream_priority.weight`.
    */
-  uint64_t max_stream_window;
+  NGTCP2_SCHED_POLICY_WEIGHTED_FAIR = 0x01,
   /**
-   * :member:`ack_thresh` is the maximum number of unacknowledged
-   * packets before sending acknowledgement.  It triggers the
-   * immediate acknowledgement.
+   * :enum:`NGTCP2_SCHED_POLICY_STRICT_PRIORITY` serves the streams of
+   * the lower :member:`ngtcp2_stream_priority.urgency` first as
+   * described in :rfc:`9218`.  The streams of the same urgency take
+   * turns if they are incremental, otherwise each of them sends all
+   * of its data in the order of stream ID.
    */
-  size_t ack_thresh;
+  NGTCP2_SCHED_POLICY_STRICT_PRIORITY = 0x02
+} ngtcp2_sched_policy;
+
+/**
+ * @enum
+ *
+ * :type:`ngtcp2_pto_probe_policy` defines the policies which decide
+ * what a PTO probe packet in 1RTT packet number space carries.
+ */
+typedef enum ngtcp2_pto_probe_policy {
   /**
-   * :member:`no_udp_payload_size_shaping`, if set to nonzero,
-   * instructs the library not to limit the UDP payload size to
-   * :macro:`NGTCP2_MAX_UDP_PAYLOAD_SIZE` (which can be extended by
-   * Path MTU Discovery) and instead use the mininum size among the
-   * given buffer size, :member:`max_udp_payload_size`, and the
-   * received max_udp_payload QUIC transport parameter.
+   * :enum:`NGTCP2_PTO_PROBE_POLICY_NEW_DATA_FIRST` makes a probe
+   * packet carry new data if the application has any, and reclaims
+   * the oldest in-flight packet only if it has none.
    */
-  int no_udp_payload_size_shaping;
+  NGTCP2_PTO_PROBE_POLICY_NEW_DATA_FIRST = 0x00,
   /**
-   * :member:`handshake_timeout` is the period of time before giving
-   * up QUIC connection establishment.  If QUIC handshake is not
-   * complete within this period, `ngtcp2_conn_handle_expiry` returns
-   * :macro:`NGTCP2_ERR_HANDSHAKE_TIMEOUT` error.  The deadline is
-   * :member:`initial_ts` + :member:`handshake_timeout`.  If this
-   * field is set to ``UINT64_MAX``, no handshake timeout is set.
+   * :enum:`NGTCP2_PTO_PROBE_POLICY_RETRANSMIT_OLDEST` makes a probe
+   * packet retransmit the frames of the oldest in-flight packet
+   * first.  New data fills the rest of the packet.
    */
-  ngtcp2_duration handshake_timeout;
+  NGTCP2_PTO_PROBE_POLICY_RETRANSMIT_OLDEST = 0x01,
   /**
-   * :member:`preferred_versions` is the array of versions that are
-   * preferred by the local endpoint.  All versions set in this array
-   * must be supported by the library, and compatible to QUIC v1.  The
-   * reserved versions are not allowed.  They are sorted in the order
-   * of preference.
-   *
-   * On compatible version negotiation, server will negotiate one of
-   * those versions contained in this array if a client initially
-   * chooses a less preferred version.  This version set corresponds
-   * to Offered Versions in QUIC Version Negotiation draft, and it should
-   * be sent in Version Negotiation packet.
-   *
-   * Client uses this field and :member:`original_version` to prevent
-   * version downgrade attack if it reacted upon Version Negotiation
-   * packet.  If this field is specified, client must include
-   * |client_chosen_version| passed to `ngtcp2_conn_client_new` unless
-   * |client_chosen_version| is a reserved version.
+   * :enum:`NGTCP2_PTO_PROBE_POLICY_DUPLICATE_LATEST` makes a probe
+   * packet retransmit the frames of the most recently sent in-flight
+   * packet first, so that the peer acknowledges the tail of the
+   * flight.  New data fills the rest of the packet.
    */
-  uint32_t *preferred_versions;
+  NGTCP2_PTO_PROBE_POLICY_DUPLICATE_LATEST = 0x02
+} ngtcp2_pto_probe_policy;
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_printf` is a callback function for logging.
+ * |user_data| is the same object passed to `ngtcp2_conn_client_new`
+ * or `ngtcp2_conn_server_new`.
+ */
+typedef void (*ngtcp2_printf)(void *user_data, const char *format, ...);
+
+/**
+ * @enum
+ *
+ * :type:`ngtcp2_log_event` defines an event of ngtcp2 library
+ * internal logger.
+ */
+typedef enum ngtcp2_log_event {
   /**
-   * :member:`preferred_versionslen` is the number of versions that
-   * are contained in the array pointed by
-   * :member:`preferred_versions`.
+   * :enum:`NGTCP2_LOG_EVENT_NONE` represents no event.
    */
-  size_t preferred_versionslen;
+  NGTCP2_LOG_EVENT_NONE,
   /**
-   * :member:`other_versions` is the array of versions that are set in
-   * :member:`other_versions <ngtcp2_version_info.other_versions>`
-   * field of outgoing version_information QUIC transport parameter.
-   *
-   * For server, this corresponds to Fully-Deployed Versions in QUIC
-   * Version Negotiation draft.  If this field is set not, it is set
-   * to :member:`preferred_versions` internally if
-   * :member:`preferred_versionslen` is not zero.  If this field is
-   * not set, and :member:`preferred_versionslen` is zero, this field
-   * is set to :macro:`NGTCP2_PROTO_VER_V1` internally.
-   *
-   * Client must include |client_chosen_version| passed to
-   * `ngtcp2_conn_client_new` in this array if this field is set and
-   * |client_chosen_version| is not a reserved version.  If this field
-   * is not set, |client_chosen_version| passed to
-   * `ngtcp2_conn_client_new` will be set in this field internally
-   * unless |client_chosen_version| is a reserved version.
+   * :enum:`NGTCP2_LOG_EVENT_CON` is a connection (catch-all) event
    */
-  uint32_t *other_versions;
+  NGTCP2_LOG_EVENT_CON,
   /**
-   * :member:`other_versionslen` is the number of versions that are
-   * contained in the array pointed by :member:`other_versions`.
+   * :enum:`NGTCP2_LOG_EVENT_PKT` is a packet event.
    */
-  size_t other_versionslen;
+  NGTCP2_LOG_EVENT_PKT,
   /**
-   * :member:`original_version` is the original version that client
-   * initially used to make a connection attempt.  If it is set, and
-   * it differs from |client_chosen_version| passed to
-   * `ngtcp2_conn_client_new`, the library assumes that client reacted
-   * upon Version Negotiation packet.  Server does not use this field.
+   * :enum:`NGTCP2_LOG_EVENT_FRM` is a QUIC frame event.
    */
-  uint32_t original_version;
+  NGTCP2_LOG_EVENT_FRM,
   /**
-   * :member:`no_pmtud`, if set to nonzero, disables Path MTU
-   * Discovery.
+   * :enum:`NGTCP2_LOG_EVENT_RCV` is a congestion and recovery event.
    */
-  int no_pmtud;
-} ngtcp2_settings;
-
-#ifdef NGTCP2_USE_GENERIC_SOCKADDR
-typedef struct ngtcp2_sockaddr {
-  uint16_t sa_family;
-  uint8_t sa_data[14];
-} ngtcp2_sockaddr;
-
-typedef struct ngtcp2_in_addr {
-  uint32_t s_addr;
-} ngtcp2_in_addr;
-
-typedef struct ngtcp2_sockaddr_in {
-  uint16_t sin_family;
-  uint16_t sin_port;
-  ngtcp2_in_addr sin_addr;
-  uint8_t sin_zero[8];
-} ngtcp2_sockaddr_in;
-
-#  define NGTCP2_SS_MAXSIZE 128
-#  define NGTCP2_SS_ALIGNSIZE (sizeof(uint64_t))
-#  define NGTCP2_SS_PAD1SIZE (NGTCP2_SS_ALIGNSIZE - sizeof(uint16_t))
-#  define NGTCP2_SS_PAD2SIZE                                                   \
-    (NGTCP2_SS_MAXSIZE -                                                       \
-     (sizeof(uint16_t) + NGTCP2_SS_PAD1SIZE + NGTCP2_SS_ALIGNSIZE))
-
-typedef struct ngtcp2_sockaddr_storage {
-  uint16_t ss_family;
-  uint8_t _ss_pad1[NGTCP2_SS_PAD1SIZE];
-  uint64_t _ss_align;
-  uint8_t _ss_pad2[NGTCP2_SS_PAD2SIZE];
-} ngtcp2_sockaddr_storage;
-
-#  undef NGTCP2_SS_PAD2SIZE
-#  undef NGTCP2_SS_PAD1SIZE
-#  undef NGTCP2_SS_ALIGNSIZE
-#  undef NGTCP2_SS_MAXSIZE
-
-typedef uint32_t ngtcp2_socklen;
-#else
-/**
- * @typedef
- *
- * :type:`ngtcp2_sockaddr` is typedefed to struct sockaddr.  If
- * :macro:`NGTCP2_USE_GENERIC_SOCKADDR` is defined, it is typedefed to
- * the generic struct sockaddr defined in ngtcp2.h.
- */
-typedef struct sockaddr ngtcp2_sockaddr;
-/**
- * @typedef
- *
- * :type:`ngtcp2_sockaddr_storage` is typedefed to struct
- * sockaddr_storage.  If :macro:`NGTCP2_USE_GENERIC_SOCKADDR` is
- * defined, it is typedefed to the generic struct sockaddr_storage
- * defined in ngtcp2.h.
- */
-typedef struct sockaddr_storage ngtcp2_sockaddr_storage;
-typedef struct sockaddr_in ngtcp2_sockaddr_in;
-/**
- * @typedef
- *
- * :type:`ngtcp2_socklen` is typedefed to socklen_t.  If
- * :macro:`NGTCP2_USE_GENERIC_SOCKADDR` is defined, it is typedefed to
- * uint32_t.
- */
-typedef socklen_t ngtcp2_socklen;
-#endif
-
-#if defined(NGTCP2_USE_GENERIC_SOCKADDR) ||                                    \
-    defined(NGTCP2_USE_GENERIC_IPV6_SOCKADDR)
-typedef struct ngtcp2_in6_addr {
-  uint8_t in6_addr[16];
-} ngtcp2_in6_addr;
-
-typedef struct ngtcp2_sockaddr_in6 {
-  uint16_t sin6_family;
-  uint16_t sin6_port;
-  uint32_t sin6_flowinfo;
-  ngtcp2_in6_addr sin6_addr;
-  uint32_t sin6_scope_id;
-} ngtcp2_sockaddr_in6;
-#else
-typedef struct sockaddr_in6 ngtcp2_sockaddr_in6;
-#endif
+  NGTCP2_LOG_EVENT_RCV,
+  /**
+   * :enum:`NGTCP2_LOG_EVENT_CRY` is a crypto event.
+   */
+  NGTCP2_LOG_EVENT_CRY,
+  /**
+   * :enum:`NGTCP2_LOG_EVENT_PTV` is a path validation event.
+   */
+  NGTCP2_LOG_EVENT_PTV,
+} ngtcp2_log_event;
 
 /**
- * @struct
+ * @enum
  *
- * :type:`ngtcp2_addr` is the endpoint address.
+ * :type:`ngtcp2_log_record_type` defines the type of
+ * :type:`ngtcp2_log_record`.
  */
-typedef struct ngtcp2_addr {
+typedef enum ngtcp2_log_record_type {
   /**
-   * :member:`addr` points to the buffer which contains endpoint
-   * address.  It must not be ``NULL``.
+   * :enum:`NGTCP2_LOG_RECORD_TYPE_INFO` is a free-form message.
    */
-  ngtcp2_sockaddr *addr;
+  NGTCP2_LOG_RECORD_TYPE_INFO,
   /**
-   * :member:`addrlen` is the length of addr.
+   * :enum:`NGTCP2_LOG_RECORD_TYPE_PKT` is a packet header which is
+   * sent or received.
    */
-  ngtcp2_socklen addrlen;
-} ngtcp2_addr;
+  NGTCP2_LOG_RECORD_TYPE_PKT,
+  /**
+   * :enum:`NGTCP2_LOG_RECORD_TYPE_FRAME` is a QUIC frame which is
+   * sent or received.
+   */
+  NGTCP2_LOG_RECORD_TYPE_FRAME,
+  /**
+   * :enum:`NGTCP2_LOG_RECORD_TYPE_PKT_LOST` is a packet which is
+   * declared lost.
+   */
+  NGTCP2_LOG_RECORD_TYPE_PKT_LOST,
+  /**
+   * :enum:`NGTCP2_LOG_RECORD_TYPE_TX_CANCEL` is a packet whose
+   * transmission is canceled.
+   */
+  NGTCP2_LOG_RECORD_TYPE_TX_CANCEL,
+  /**
+   * :enum:`NGTCP2_LOG_RECORD_TYPE_VERSION_NEGOTIATION` is a received
+   * Version Negotiation packet.
+   */
+  NGTCP2_LOG_RECORD_TYPE_VERSION_NEGOTIATION,
+  /**
+   * :enum:`NGTCP2_LOG_RECORD_TYPE_STATELESS_RESET` is a received
+   * Stateless Reset packet.
+   */
+  NGTCP2_LOG_RECORD_TYPE_STATELESS_RESET,
+  /**
+   * :enum:`NGTCP2_LOG_RECORD_TYPE_REMOTE_TRANSPORT_PARAMS` is the
+   * transport parameters received from the remote endpoint.
+   */
+  NGTCP2_LOG_RECORD_TYPE_REMOTE_TRANSPORT_PARAMS,
+} ngtcp2_log_record_type;
 
 /**
  * @struct
  *
- * :type:`ngtcp2_path` is the network endpoints where a packet is sent
- * and received.
+ * :type:`ngtcp2_log_record` is a log event which has not been
+ * rendered yet.  It is passed to :type:`ngtcp2_log_record_cb`, and
+ * it is only valid during the call.  The typed fields are meant for
+ * filtering.  Pass it to `ngtcp2_log_record_print` to render it into
+ * the same text that :member:`ngtcp2_settings.log_printf` receives.
  */
-typedef struct ngtcp2_path {
+typedef struct ngtcp2_log_record {
   /**
-   * :member:`local` is the address of local endpoint.
+   * :member:`type` is the type of this record.
    */
-  ngtcp2_addr local;
+  ngtcp2_log_record_type type;
   /**
-   * :member:`remote` is the address of remote endpoint.
+   * :member:`event` is the event category of this record.
    */
-  ngtcp2_addr remote;
+  ngtcp2_log_event event;
   /**
-   * :member:`user_data` is an arbitrary data and opaque to the
-   * library.
-   *
-   * Note that :type:`ngtcp2_path` is generally passed to
-   * :type:`ngtcp2_conn` by an application, and :type:`ngtcp2_conn`
-   * stores their copies.  Unfortunately, there is no way for the
-   * application to know when :type:`ngtcp2_conn` finishes using a
-   * specific :type:`ngtcp2_path` object in mid connection, which
-   * means that the application cannot free the data pointed by this
-   * field.  Therefore, it is advised to use this field only when the
-   * data pointed by this field persists in an entire lifetime of the
-   * connection.
+   * :member:`elapsed` is the duration since the connection was
+   * created.
    */
-  void *user_data;
-} ngtcp2_path;
-
-/**
- * @struct
- *
- * :type:`ngtcp2_path_storage` is a convenient struct to have buffers
- * to store the longest addresses.
- */
-typedef struct ngtcp2_path_storage {
+  ngtcp2_duration elapsed;
   /**
-   * :member:`path` stores network path.
+   * :member:`scid` is the Source Connection ID of the connection,
+   * encoded as a NULL-terminated hex string.
    */
-  ngtcp2_path path;
+  const char *scid;
   /**
-   * :member:`local_addrbuf` is a buffer to store local address.
+   * :member:`tx` is nonzero if the packet or frame is sent, rather
+   * than received.  It is only meaningful for
+   * :enum:`ngtcp2_log_record_type.NGTCP2_LOG_RECORD_TYPE_PKT` and
+   * :enum:`ngtcp2_log_record_type.NGTCP2_LOG_RECORD_TYPE_FRAME`.
    */
-  ngtcp2_sockaddr_storage local_addrbuf;
+  int tx;
   /**
-   * :member:`remote_addrbuf` is a buffer to store remote address.
+   * :member:`hd` is the packet header.  It is ``NULL`` if the record
+   * is not about a particular packet.
    */
-  ngtcp2_sockaddr_storage remote_addrbuf;
-} ngtcp2_path_storage;
+  const ngtcp2_pkt_hd *hd;
+  /**
+   * :member:`frame_type` is the type of QUIC frame.  It is only
+   * meaningful for
+   * :enum:`ngtcp2_log_record_type.NGTCP2_LOG_RECORD_TYPE_FRAME`.
+   */
+  uint64_t frame_type;
+  /**
+   * :member:`data` is the type specific payload which is only
+   * interpreted by `ngtcp2_log_record_print`.
+   */
+  const void *data;
+} ngtcp2_log_record;
 
 /**
- * @struct
+ * @functypedef
  *
- * :type:`ngtcp2_crypto_md` is a wrapper around native message digest
- * object.
+ * :type:`ngtcp2_log_record_cb` is a callback function for structured
+ * logging.  |user_data| is the same object passed to
+ * `ngtcp2_conn_client_new` or `ngtcp2_conn_server_new`.
  */
-typedef struct ngtcp2_crypto_md {
-  /**
-   * :member:`native_handle` is a pointer to an underlying message
-   * digest object.
-   */
-  void *native_handle;
-} ngtcp2_crypto_md;
+typedef void (*ngtcp2_log_record_cb)(void *user_data,
+                                     const ngtcp2_log_record *rec);
 
 /**
- * @struct
+ * @macrosection
  *
- * :type:`ngtcp2_crypto_aead` is a wrapper around native AEAD object.
+ * QLog related macros
  */
-typedef struct ngtcp2_crypto_aead {
-  /**
-   * :member:`native_handle` is a pointer to an underlying AEAD
-   * object.
-   */
-  void *native_handle;
-  /**
-   * :member:`max_overhead` is the number of additional bytes which
-   * AEAD encryption needs on encryption.
-   */
-  size_t max_overhead;
-} ngtcp2_crypto_aead;
 
 /**
- * @struct
+ * @macro
  *
- * :type:`ngtcp2_crypto_cipher` is a wrapper around native cipher
- * object.
+ * :macro:`NGTCP2_QLOG_WRITE_FLAG_NONE` indicates no flag set.
  */
-typedef struct ngtcp2_crypto_cipher {
-  /**
-   * :member:`native_handle` is a pointer to an underlying cipher
-   * object.
-   */
-  void *native_handle;
-} ngtcp2_crypto_cipher;
+#define NGTCP2_QLOG_WRITE_FLAG_NONE 0x00u
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_QLOG_WRITE_FLAG_FIN` indicates that this is the
+ * final call to :type:`ngtcp2_qlog_write` in the current connection.
+ */
+#define NGTCP2_QLOG_WRITE_FLAG_FIN 0x01u
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_QLOG_FILTER_NONE` indicates that all events are
+ * written.
+ */
+#define NGTCP2_QLOG_FILTER_NONE 0x00u
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_QLOG_FILTER_FRAMES` omits frames from
+ * packet_sent and packet_received events.  Packet headers are still
+ * written.
+ */
+#define NGTCP2_QLOG_FILTER_FRAMES 0x01u
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_QLOG_FILTER_PKT` omits packet_sent and
+ * packet_received events.
+ */
+#define NGTCP2_QLOG_FILTER_PKT 0x02u
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_QLOG_FILTER_METRICS` omits metrics_updated and
+ * send_limited events.
+ */
+#define NGTCP2_QLOG_FILTER_METRICS 0x04u
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_QLOG_FILTER_LOSS` omits packet_lost and
+ * pto_probe_sent events.
+ */
+#define NGTCP2_QLOG_FILTER_LOSS 0x08u
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_QLOG_FILTER_PARAMETERS` omits parameters_set
+ * events.
+ */
+#define NGTCP2_QLOG_FILTER_PARAMETERS 0x10u
 
 /**
  * @struct
  *
- * :type:`ngtcp2_crypto_aead_ctx` is a wrapper around native AEAD
- * cipher context object.  It should be initialized with a specific
- * key.  ngtcp2 library reuses this context object to encrypt or
- * decrypt multiple packets.
+ * :type:`ngtcp2_rand_ctx` is a wrapper around native random number
+ * generator.  It is opaque to the ngtcp2 library.  This might be
+ * useful if application needs to specify random number generator per
+ * thread or per connection.
  */
-typedef struct ngtcp2_crypto_aead_ctx {
+typedef struct ngtcp2_rand_ctx {
   /**
-   * :member:`native_handle` is a pointer to an underlying AEAD
-   * context object.
+   * :member:`native_handle` is a pointer to an underlying random
+   * number generator.
    */
   void *native_handle;
-} ngtcp2_crypto_aead_ctx;
+} ngtcp2_rand_ctx;
 
 /**
- * @struct
+ * @functypedef
  *
- * :type:`ngtcp2_crypto_cipher_ctx` is a wrapper around native cipher
- * context object.  It should be initialized with a specific key.
- * ngtcp2 library reuses this context object to encrypt or decrypt
- * multiple packet headers.
+ * :type:`ngtcp2_qlog_write` is a callback function which is called to
+ * write qlog |data| of length |datalen| bytes.  |flags| is bitwise OR
+ * of zero or more of :macro:`NGTCP2_QLOG_WRITE_FLAG_*
+ * <NGTCP2_QLOG_WRITE_FLAG_NONE>`.  If
+ * :macro:`NGTCP2_QLOG_WRITE_FLAG_FIN` is set, |datalen| may be 0.
  */
-typedef struct ngtcp2_crypto_cipher_ctx {
+typedef void (*ngtcp2_qlog_write)(void *user_data, uint32_t flags,
+                                  const void *data, size_t datalen);
+
+/**
+ * @enum
+ *
+ * :type:`ngtcp2_qlog_format` defines the encodings of qlog.
+ */
+typedef enum ngtcp2_qlog_format {
   /**
-   * :member:`native_handle` is a pointer to an underlying cipher
-   * context object.
+   * :enum:`NGTCP2_QLOG_FORMAT_JSON_SEQ` is qlog in JSON Text Sequences
+   * format.
    */
-  void *native_handle;
-} ngtcp2_crypto_cipher_ctx;
+  NGTCP2_QLOG_FORMAT_JSON_SEQ = 0x00,
+  /**
+   * :enum:`NGTCP2_QLOG_FORMAT_BINARY` is a compact binary encoding
+   * of the same events.  Event types, timestamps and frame fields are
+   * encoded in QUIC variable-length integer, and no text formatting
+   * is done while a connection is running.  The output is not qlog
+   * itself; use qlogconv program in examples directory to convert it
+   * to JSON Text Sequences offline.
+   */
+  NGTCP2_QLOG_FORMAT_BINARY = 0x01
+} ngtcp2_qlog_format;
 
 /**
  * @struct
  *
- * :type:`ngtcp2_crypto_ctx` is a convenient structure to bind all
- * crypto related objects in one place.  Use
- * `ngtcp2_crypto_ctx_initial` to initialize this struct for Initial
- * packet encryption.  For Handshake and 1RTT packets, use
- * `ngtcp2_crypto_ctx_tls`.
+ * :type:`ngtcp2_qlog_settings` is a set of settings for qlog.
  */
-typedef struct ngtcp2_crypto_ctx {
+typedef struct ngtcp2_qlog_settings {
   /**
-   * :member:`aead` is AEAD object.
+   * :member:`odcid` is Original Destination Connection ID sent by
+   * client.  It is used as group_id and ODCID fields.  Client ignores
+   * this field and uses dcid parameter passed to
+   * `ngtcp2_conn_client_new()`.
    */
-  ngtcp2_crypto_aead aead;
+  ngtcp2_cid odcid;
   /**
-   * :member:`md` is message digest object.
+   * :member:`write` is a callback function to write qlog.  Setting
+   * ``NULL`` disables qlog.
    */
-  ngtcp2_crypto_md md;
+  ngtcp2_qlog_write write;
   /**
-   * :member:`hp` is header protection cipher.
+   * :member:`format` is the encoding of qlog.  The default is
+   * :enum:`ngtcp2_qlog_format.NGTCP2_QLOG_FORMAT_JSON_SEQ`.
    */
-  ngtcp2_crypto_cipher hp;
+  ngtcp2_qlog_format format;
   /**
-   * :member:`max_encryption` is the number of encryption which this
-   * key can be used with.
+   * :member:`filter` is bitwise OR of zero or more of
+   * :macro:`NGTCP2_QLOG_FILTER_* <NGTCP2_QLOG_FILTER_NONE>` which
+   * selects the events that are not written.  Filtered events cost
+   * no formatting work.
    */
-  uint64_t max_encryption;
+  uint32_t filter;
   /**
-   * :member:`max_decryption_failure` is the number of decryption
-   * failure with this key.
+   * :member:`pkt_sample_interval`, if it is larger than 1, writes
+   * only every :member:`pkt_sample_interval`-th packet_sent and
+   * packet_received event.  The events of the other packets,
+   * including their frames, are skipped before they are formatted.
    */
-  uint64_t max_decryption_failure;
-} ngtcp2_crypto_ctx;
+  uint32_t pkt_sample_interval;
+  /**
+   * :member:`metrics_sample_interval`, if it is larger than 1,
+   * writes only every :member:`metrics_sample_interval`-th
+   * metrics_updated event.
+   */
+  uint32_t metrics_sample_interval;
+} ngtcp2_qlog_settings;
 
 /**
- * @function
- *
- * `ngtcp2_encode_transport_params` encodes |params| in |dest| of
- * length |destlen|.
- *
- * If |dest| is NULL, and |destlen| is zero, this function just
- * returns the number of bytes required to store the encoded transport
- * parameters.
- *
- * This function returns the number of written, or one of the
- * following negative error codes:
+ * @struct
  *
- * :macro:`NGTCP2_ERR_NOBUF`
- *     Buffer is too small.
- * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
- *     |exttype| is invalid.
+ * :type:`ngtcp2_cc_resume_params` is the congestion control state of
+ * a path which a previous connection to the same remote endpoint
+ * learned.  It is obtained by `ngtcp2_conn_get_cc_resume_params`, and
+ * it is given to a new connection through
+ * :member:`ngtcp2_settings.cc_resume`.
  */
-NGTCP2_EXTERN ngtcp2_ssize ngtcp2_encode_transport_params_versioned(
-    uint8_t *dest, size_t destlen, ngtcp2_transport_params_type exttype,
-    int transport_params_version, const ngtcp2_transport_params *params);
+typedef struct ngtcp2_cc_resume_params {
+  /**
+   * :member:`min_rtt` is the minimum RTT of the path.
+   */
+  ngtcp2_duration min_rtt;
+  /**
+   * :member:`max_bw` is the maximum delivery rate of the path in
+   * bytes per second.  0 means that it is unknown.
+   */
+  uint64_t max_bw;
+  /**
+   * :member:`cwnd` is the congestion window.  0 means that the
+   * parameters are not available.
+   */
+  uint64_t cwnd;
+} ngtcp2_cc_resume_params;
+
+#define NGTCP2_SETTINGS_VERSION_V1 1
+#define NGTCP2_SETTINGS_VERSION NGTCP2_SETTINGS_VERSION_V1
 
 /**
- * @function
- *
- * `ngtcp2_decode_transport_params` decodes transport parameters in
- * |data| of length |datalen|, and stores the result in the object
- * pointed by |params|.
- *
- * If the optional parameters are missing, the default value is
- * assigned.
- *
- * The following fields may point to somewhere inside the buffer
- * pointed by |data| of length |datalen|:
- *
- * - :member:`ngtcp2_transport_params.version_info.other_versions
- *   <ngtcp2_version_info.other_versions>`
- *
- * This function returns 0 if it succeeds, or one of the following
- * negative error codes:
+ * @struct
  *
- * :macro:`NGTCP2_ERR_REQUIRED_TRANSPORT_PARAM`
- *     The required parameter is missing.
- * :macro:`NGTCP2_ERR_MALFORMED_TRANSPORT_PARAM`
- *     The input is malformed.
+ * :type:`ngtcp2_shared_pool` is an opaque object pool which the
+ * connections running on the same thread share.  See
+ * `ngtcp2_shared_pool_new`.
  */
-NGTCP2_EXTERN int ngtcp2_decode_transport_params_versioned(
-    int transport_params_version, ngtcp2_transport_params *params,
-    ngtcp2_transport_params_type exttype, const uint8_t *data, size_t datalen);
+typedef struct ngtcp2_shared_pool ngtcp2_shared_pool;
 
 /**
- * @function
- *
- * `ngtcp2_decode_transport_params_new` decodes transport parameters
- * in |data| of length |datalen|, and stores the result in the object
- * allocated dynamically.  The pointer to the allocated object is
- * assigned to |*pparams|.  Unlike `ngtcp2_decode_transport_params`,
- * all direct and indirect fields are also allocated dynamically if
- * needed.
- *
- * |mem| is a memory allocator to allocate memory.  If |mem| is
- * ``NULL``, the memory allocator returned by `ngtcp2_mem_default()`
- * is used.
- *
- * If the optional parameters are missing, the default value is
- * assigned.
+ * @struct
  *
- * `ngtcp2_transport_params_del` frees the memory allocated by this
- * function.
- *
- * This function returns 0 if it succeeds, or one of the following
- * negative error codes:
- *
- * :macro:`NGTCP2_ERR_REQUIRED_TRANSPORT_PARAM`
- *     The required parameter is missing.
- * :macro:`NGTCP2_ERR_MALFORMED_TRANSPORT_PARAM`
- *     The input is malformed.
- * :macro:`NGTCP2_ERR_NOMEM`
- *     Out of memory.
- */
-NGTCP2_EXTERN int ngtcp2_decode_transport_params_new(
-    ngtcp2_transport_params **pparams, ngtcp2_transport_params_type exttype,
-    const uint8_t *data, size_t datalen, const ngtcp2_mem *mem);
-
-/**
- * @function
- *
- * `ngtcp2_transport_params_del` frees the |params| which must be
- * dynamically allocated by `ngtcp2_decode_transport_params_new`.
- *
- * |mem| is a memory allocator that allocated |params|.  If |mem| is
- * ``NULL``, the memory allocator returned by `ngtcp2_mem_default()`
- * is used.
- *
- * If |params| is ``NULL``, this function does nothing.
- */
-NGTCP2_EXTERN void ngtcp2_transport_params_del(ngtcp2_transport_params *params,
-                                               const ngtcp2_mem *mem);
-
-/**
- * @struct
- *
- * :type:`ngtcp2_version_cid` is a convenient struct to store the
- * result of `ngtcp2_pkt_decode_version_cid`.
+ * :type:`ngtcp2_settings` defines QUIC connection settings.
  */
-typedef struct ngtcp2_version_cid {
+typedef struct ngtcp2_settings {
   /**
-   * :member:`version` stores QUIC version.
+   * :member:`qlog` is qlog settings.
    */
-  uint32_t version;
+  ngtcp2_qlog_settings qlog;
   /**
-   * :member:`dcid` points to the Destination Connection ID.
+   * :member:`cc_algo` specifies congestion control algorithm.
    */
-  const uint8_t *dcid;
+  ngtcp2_cc_algo cc_algo;
   /**
-   * :member:`dcidlen` is the length of the Destination Connection ID
-   * pointed by :member:`dcid`.
+   * :member:`initial_ts` is an initial timestamp given to the
+   * library.
    */
-  size_t dcidlen;
+  ngtcp2_tstamp initial_ts;
   /**
-   * :member:`scid` points to the Source Connection ID.
+   * :member:`initial_rtt` is an initial RTT.
    */
-  const uint8_t *scid;
+  ngtcp2_duration initial_rtt;
   /**
-   * :member:`scidlen` is the length of the Source Connection ID
-   * pointed by :member:`scid`.
+   * :member:`log_printf` is a function that the library uses to write
+   * logs.  ``NULL`` means no logging output.  It is nothing to do
+   * with qlog.
    */
-  size_t scidlen;
-} ngtcp2_version_cid;
+  ngtcp2_printf log_printf;
+  /**
+   * :member:`max_udp_payload_size` is the maximum size of UDP
+   * datagram payload that this endpoint transmits.  It is used by
+   * congestion controller to compute congestion window.
+   */
+  size_t max_udp_payload_size;
+  /**
+   * :member:`token` is a token from Retry packet or NEW_TOKEN frame.
+   *
+   * Server sets this field if it received the token in Client Initial
+   * packet and successfully validated.
+   *
+   * Client sets this field if it intends to send token in its Initial
+   * packet.
+   *
+   * `ngtcp2_conn_server_new` and `ngtcp2_conn_client_new` make a copy
+   * of token.  The copy is freed when the handshake is confirmed.
+   */
+  ngtcp2_vec token;
+  /**
+   * :member:`rand_ctx` is an optional random number generator to be
+   * passed to :type:`ngtcp2_rand` callback.
+   */
+  ngtcp2_rand_ctx rand_ctx;
+  /**
+   * :member:`max_window` is the maximum connection-level flow control
+   * window if connection-level window auto-tuning is enabled.  The
+   * connection-level window auto tuning is enabled if nonzero value
+   * is specified in this field.  The initial value of window size is
+   * :member:`ngtcp2_transport_params.initial_max_data`.  The window
+   * size is scaled up to the value specified in this field.  When
+   * the window is consumed within 2 RTTs, it is at least doubled, or
+   * grown to twice the bandwidth-delay product estimated from the
+   * receiving rate and smoothed RTT if that is larger.
+   */
+  uint64_t max_window;
+  /**
+   * :member:`max_stream_window` is the maximum stream-level flow
+   * control window if stream-level window auto-tuning is enabled.
+   * The stream-level window auto-tuning is enabled if nonzero value
+   * is specified in this field.  The initial value of window size is
+   * :member:`ngtcp2_transport_params.initial_max_stream_data_bidi_remote`,
+   * :member:`ngtcp2_transport_params.initial_max_stream_data_bidi_local`,
+   * or :member:`ngtcp2_transport_params.initial_max_stream_data_uni`,
+   * depending on the type of stream.  The window size is scaled up to
+   * the value specified in this field in the same way as
+   * :member:`max_window`.
+   */
+  uint64_t max_stream_window;
+  /**
+   * :member:`ack_thresh` is the maximum number of unacknowledged
+   * packets before sending acknowledgement.  It triggers the
+   * immediate acknowledgement.
+   */
+  size_t ack_thresh;
+  /**
+   * :member:`no_udp_payload_size_shaping`, if set to nonzero,
+   * instructs the library not to limit the UDP payload size to
+   * :macro:`NGTCP2_MAX_UDP_PAYLOAD_SIZE` (which can be extended by
+   * Path MTU Discovery) and instead use the mininum size among the
+   * given buffer size, :member:`max_udp_payload_size`, and the
+   * received max_udp_payload QUIC transport parameter.
+   */
+  int no_udp_payload_size_shaping;
+  /**
+   * :member:`handshake_timeout` is the period of time before giving
+   * up QUIC connection establishment.  If QUIC handshake is not
+   * complete within this period, `ngtcp2_conn_handle_expiry` returns
+   * :macro:`NGTCP2_ERR_HANDSHAKE_TIMEOUT` error.  The deadline is
+   * :member:`initial_ts` + :member:`handshake_timeout`.  If this
+   * field is set to ``UINT64_MAX``, no handshake timeout is set.
+   */
+  ngtcp2_duration handshake_timeout;
+  /**
+   * :member:`preferred_versions` is the array of versions that are
+   * preferred by the local endpoint.  All versions set in this array
+   * must be supported by the library, and compatible to QUIC v1.  The
+   * reserved versions are not allowed.  They are sorted in the order
+   * of preference.
+   *
+   * On compatible version negotiation, server will negotiate one of
+   * those versions contained in this array if a client initially
+   * chooses a less preferred version.  This version set corresponds
+   * to Offered Versions in QUIC Version Negotiation draft, and it should
+   * be sent in Version Negotiation packet.
+   *
+   * Client uses this field and :member:`original_version` to prevent
+   * version downgrade attack if it reacted upon Version Negotiation
+   * packet.  If this field is specified, client must include
+   * |client_chosen_version| passed to `ngtcp2_conn_client_new` unless
+   * |client_chosen_version| is a reserved version.
+   */
+  uint32_t *preferred_versions;
+  /**
+   * :member:`preferred_versionslen` is the number of versions that
+   * are contained in the array pointed by
+   * :member:`preferred_versions`.
+   */
+  size_t preferred_versionslen;
+  /**
+   * :member:`other_versions` is the array of versions that are set in
+   * :member:`other_versions <ngtcp2_version_info.other_versions>`
+   * field of outgoing version_information QUIC transport parameter.
+   *
+   * For server, this corresponds to Fully-Deployed Versions in QUIC
+   * Version Negotiation draft.  If this field is set not, it is set
+   * to :member:`preferred_versions` internally if
+   * :member:`preferred_versionslen` is not zero.  If this field is
+   * not set, and :member:`preferred_versionslen` is zero, this field
+   * is set to :macro:`NGTCP2_PROTO_VER_V1` internally.
+   *
+   * Client must include |client_chosen_version| passed to
+   * `ngtcp2_conn_client_new` in this array if this field is set and
+   * |client_chosen_version| is not a reserved version.  If this field
+   * is not set, |client_chosen_version| passed to
+   * `ngtcp2_conn_client_new` will be set in this field internally
+   * unless |client_chosen_version| is a reserved version.
+   */
+  uint32_t *other_versions;
+  /**
+   * :member:`other_versionslen` is the number of versions that are
+   * contained in the array pointed by :member:`other_versions`.
+   */
+  size_t other_versionslen;
+  /**
+   * :member:`original_version` is the original version that client
+   * initially used to make a connection attempt.  If it is set, and
+   * it differs from |client_chosen_version| passed to
+   * `ngtcp2_conn_client_new`, the library assumes that client reacted
+   * upon Version Negotiation packet.  Server does not use this field.
+   */
+  uint32_t original_version;
+  /**
+   * :member:`no_pmtud`, if set to nonzero, disables Path MTU
+   * Discovery.
+   */
+  int no_pmtud;
+  /**
+   * :member:`decrypt_in_place`, if set to nonzero, tells the library
+   * that the buffer passed to `ngtcp2_conn_read_pkt` is writable.
+   * The library then decrypts the payload of 0RTT, Handshake, and
+   * 1RTT packets in the buffer instead of copying it into the
+   * internal buffer, and the stream data passed to
+   * :member:`ngtcp2_callbacks.recv_stream_data` points directly into
+   * it.  The content of the buffer is undefined after
+   * `ngtcp2_conn_read_pkt` returns except for the stream data passed
+   * with :macro:`NGTCP2_STREAM_DATA_FLAG_IN_PLACE`.
+   */
+  int decrypt_in_place;
+  /**
+   * :member:`mem_budget`, if set to nonzero, is the number of bytes
+   * that a connection may allocate, as reported by
+   * :member:`ngtcp2_mem_stat.total`.  The budget does not fail
+   * allocations.  Instead, while it is exceeded, the library stops
+   * sending MAX_DATA frames and stops growing the flow control
+   * windows, so that a peer cannot make the connection buffer more
+   * data.  Normal operation resumes when the memory usage falls
+   * below the budget.  The memory usage is only counted if it is
+   * nonzero because counting adds a small overhead to each
+   * allocation.  Set it to ``UINT64_MAX`` to count the memory usage
+   * without limiting it.
+   */
+  uint64_t mem_budget;
+  /**
+   * :member:`loan_stream_data`, if set to nonzero, makes the library
+   * lend the stream data buffered out of order to the application
+   * instead of freeing it when
+   * :member:`ngtcp2_callbacks.recv_stream_data` returns.  Such data
+   * is passed with :macro:`NGTCP2_STREAM_DATA_FLAG_LOANED`, and the
+   * application can keep the pointer without copying it until it
+   * calls `ngtcp2_conn_release_stream_data`.  The data received in
+   * order is passed by reference to the packet buffer regardless of
+   * this field.
+   */
+  int loan_stream_data;
+  /**
+   * :member:`sched_policy` is the policy to schedule the streams.
+   * The default is
+   * :enum:`ngtcp2_sched_policy.NGTCP2_SCHED_POLICY_ROUND_ROBIN`.
+   */
+  ngtcp2_sched_policy sched_policy;
+  /**
+   * :member:`ack_freq`, if set to nonzero, makes the library ask the
+   * remote endpoint to send fewer acknowledgements by sending
+   * ACK_FREQUENCY frame, provided that it advertised
+   * :member:`ngtcp2_transport_params.min_ack_delay`.  The requested
+   * frequency follows the congestion window and smoothed RTT: about
+   * a quarter of the congestion window is acknowledged at a time,
+   * and acknowledgements are delayed up to a quarter of smoothed
+   * RTT, but not longer than the remote max_ack_delay.  PTO probe
+   * packets carry IMMEDIATE_ACK frame.
+   */
+  int ack_freq;
+  /**
+   * :member:`pacing_horizon`, if nonzero, allows the library to write
+   * paced packets up to this duration ahead of their departure time.
+   * Departure times of the successive batches are then chained, so
+   * that they keep the pacing rate even if they are written early.
+   * The application must not send those packets before the time
+   * returned by `ngtcp2_conn_get_pkt_tx_time`, typically by letting
+   * the kernel hold them with ``SO_TXTIME``.  Packets are still
+   * timestamped when they are written, which inflates RTT samples by
+   * up to this duration, so keep it to a few milliseconds.  The
+   * default is 0, which makes the application send packets when they
+   * are written.
+   */
+  ngtcp2_duration pacing_horizon;
+  /**
+   * :member:`perf_stat`, if set to nonzero, makes the connection
+   * measure the CPU time spent in each processing phase, which is
+   * obtained by `ngtcp2_conn_get_perf_stat`.  It has no effect
+   * unless the library is built with ``--enable-perf-stat``.  It
+   * reads a monotonic clock a few times per packet, so it is
+   * disabled by default.
+   */
+  int perf_stat;
+  /**
+   * :member:`log_record`, if set, receives each log event as
+   * :type:`ngtcp2_log_record` instead of text, and takes precedence
+   * over :member:`log_printf`.  The library does not format anything
+   * until the callback calls `ngtcp2_log_record_print`, so that the
+   * events which are not shown cost little.
+   */
+  ngtcp2_log_record_cb log_record;
+  /**
+   * :member:`eager_key_update`, if set to nonzero, makes the library
+   * derive the keys of the next key phase as soon as the current key
+   * update is confirmed, instead of 1 PTO later.  The keys are
+   * derived by :member:`ngtcp2_callbacks.update_key` from the next
+   * call of `ngtcp2_conn_read_pkt`, `ngtcp2_conn_writev_stream` and
+   * alike, or `ngtcp2_conn_prepare_key_update`, so that the
+   * following key phase change only swaps the keys.  The decryption
+   * key of the previous key phase is still kept for 1 PTO, unless
+   * the next key phase starts before that.
+   */
+  int eager_key_update;
+  /**
+   * :member:`hystart`, if set to nonzero, enables HyStart++
+   * (:rfc:`9406`) in the initial slow start of Reno, CUBIC, and
+   * Prague.  When RTT increases during slow start, the congestion
+   * window grows more slowly for a few rounds in Conservative Slow
+   * Start, and slow start ends unless RTT decreases again, so that
+   * the congestion window does not overshoot until packets are lost.
+   * The outcome is recorded in :member:`ngtcp2_conn_stat.ss_exit_reason`
+   * and alike.  `ngtcp2_settings_default` sets this field to 1.
+   */
+  int hystart;
+  /**
+   * :member:`pmtud_search`, if set to nonzero, makes Path MTU
+   * Discovery find the UDP payload size by binary search instead of
+   * trying a few fixed candidates up to
+   * :macro:`NGTCP2_MAX_PMTUD_UDP_PAYLOAD_SIZE`.  The MTUs of
+   * Ethernet and jumbo frames are tried first, and then the size is
+   * bisected up to the smallest of 65527,
+   * :member:`max_udp_payload_size`, and the max_udp_payload_size
+   * transport parameter of the remote endpoint.  Set
+   * :member:`max_udp_payload_size` to the largest size that the
+   * application can send, for example 9000 - 48 for a path with
+   * jumbo frames.  The buffer passed to `ngtcp2_conn_write_pkt` and
+   * alike must be large enough to contain the probe packets.
+   */
+  int pmtud_search;
+  /**
+   * :member:`cc_resume`, if its :member:`cwnd
+   * <ngtcp2_cc_resume_params.cwnd>` is nonzero, is the congestion
+   * control state that a previous connection learned on the path to
+   * the same remote endpoint.  It lets Reno, CUBIC, and Prague skip
+   * slow start in the style of Careful Resume.  Once the handshake is
+   * confirmed, and the first RTT sample is within [min_rtt / 2,
+   * min_rtt * 10], the congestion window jumps to half of the saved
+   * congestion window, which is capped by the saved bandwidth-delay
+   * product, and slow start ends.  The jump is paced over smoothed
+   * RTT.  If congestion is detected before the first packet sent
+   * after the jump is acknowledged, the congestion window retreats to
+   * half of the bytes acknowledged since the jump.  It is ignored by
+   * BBR, BBR v2, and a congestion controller installed by
+   * `ngtcp2_conn_set_cc_callbacks`.
+   */
+  ngtcp2_cc_resume_params cc_resume;
+  /**
+   * :member:`fast_nat_rebinding`, if set to nonzero, makes server
+   * treat the new path as validated when client migrates from a
+   * validated path, and only its port number changes, which is
+   * typically caused by NAT rebinding.  Server keeps sending at the
+   * full rate without the anti-amplification limit, and keeps ECN
+   * validation state.  The path is still
+   * validated with PATH_CHALLENGE in the background, and server
+   * falls back to the previous path if the validation fails.
+   * Because the new remote address shares the IP address with the
+   * previous one, an off-path attacker can direct the traffic only to
+   * the same host.  Congestion control state is kept on NAT
+   * rebinding regardless of this field.  Client ignores this field.
+   */
+  int fast_nat_rebinding;
+  /**
+   * :member:`transport_params_template`, if not NULL, is used by
+   * `ngtcp2_conn_encode_local_transport_params` to copy the
+   * connection independent part of the local transport parameters
+   * instead of encoding them.  The per-connection fields, such as
+   * original_dcid, initial_scid, retry_scid, and the stateless reset
+   * token, are always encoded.  If the local transport parameters do
+   * not match the template, it is ignored.  The object must outlive
+   * the connection.  Client ignores this field.
+   */
+  const ngtcp2_transport_params_template *transport_params_template;
+  /**
+   * :member:`shared_pool`, if not NULL, is the object pool that the
+   * connection draws the frame chains, the retransmission entries,
+   * and the streams from instead of its own pools.  The pool is not
+   * thread-safe, and all connections using it must run on the same
+   * thread.  It must outlive the connections.
+   */
+  ngtcp2_shared_pool *shared_pool;
+  /**
+   * :member:`publish_conn_stat`, if set to nonzero, makes the
+   * connection copy its statistics at the end of
+   * `ngtcp2_conn_read_pkt` and `ngtcp2_conn_write_pkt`, so that the
+   * other threads can read them with
+   * `ngtcp2_conn_get_published_conn_stat` without a lock.  It costs
+   * a copy of :type:`ngtcp2_conn_stat` per call, so it is disabled
+   * by default.
+   */
+  int publish_conn_stat;
+  /**
+   * :member:`latency_stat`, if set to nonzero, makes the connection
+   * record the histograms of :type:`ngtcp2_latency_stat`, which is
+   * obtained by `ngtcp2_conn_get_latency_stat`.  It allocates the
+   * histograms when the connection is created, and records nothing
+   * else at run time, so that the memory usage stays fixed.  It is
+   * disabled by default.
+   */
+  int latency_stat;
+  /**
+   * :member:`auto_max_streams`, if set to nonzero, makes the library
+   * extend the maximum number of streams that a remote endpoint can
+   * open by 1 when a stream opened by the remote endpoint is closed.
+   * The application must not call
+   * `ngtcp2_conn_extend_max_streams_bidi` nor
+   * `ngtcp2_conn_extend_max_streams_uni` in this case.  The
+   * extension is not sent until it reaches the half of the current
+   * stream window, so that MAX_STREAMS is not sent per stream
+   * closure.  It is sent immediately if the remote endpoint sends
+   * STREAMS_BLOCKED.  The stream window is initially
+   * :member:`ngtcp2_transport_params.initial_max_streams_bidi` or
+   * :member:`ngtcp2_transport_params.initial_max_streams_uni`, and
+   * see :member:`max_streams_window` for how it grows.
+   */
+  int auto_max_streams;
+  /**
+   * :member:`max_streams_window` is the maximum stream window that
+   * the automatic stream credit management can grow to.  If
+   * :member:`auto_max_streams` is nonzero, and the remote endpoint
+   * sends STREAMS_BLOCKED, the window is doubled up to this value,
+   * and the difference is given to the remote endpoint as the
+   * additional stream credit.  If it is 0, or it is not larger than
+   * the initial window, the window is not grown.  It must not exceed
+   * 1 << 60, which is the maximum number of streams in QUIC.
+   */
+  uint64_t max_streams_window;
+  /**
+   * :member:`ack_ce_on_change`, if set to nonzero, makes the
+   * connection send an ACK frame immediately only when ECN marking
+   * of the received packets changes from non-CE to CE or vice versa,
+   * as DCTCP receiver does.  By default, every ack-eliciting packet
+   * marked with CE is acknowledged immediately, which makes a
+   * connection acknowledge every packet if a path marks most of them
+   * as L4S bottleneck does.  The onset and the end of CE marking are
+   * still reported without delay, and the ECN counts in ACK frame
+   * stay accurate.
+   */
+  int ack_ce_on_change;
+  /**
+   * :member:`spin_bit`, if set to nonzero, enables the latency spin
+   * bit described in :rfc:`9000#section-17.4`, so that the on-path
+   * observers can measure RTT passively.  Even if it is enabled, the
+   * library disables it for 1 in 16 connections at random as the RFC
+   * requires.  If the spin bit is disabled, it is set to a random
+   * value chosen per connection, and the incoming value is ignored.
+   */
+  int spin_bit;
+  /**
+   * :member:`pto_probe_policy` is the policy which decides what a PTO
+   * probe packet in 1RTT packet number space carries.  The library
+   * writes pto_probe_sent event to qlog for each probe packet, so
+   * that the tail recovery latency of the policies can be compared.
+   * The default is
+   * :enum:`ngtcp2_pto_probe_policy.NGTCP2_PTO_PROBE_POLICY_NEW_DATA_FIRST`.
+   */
+  ngtcp2_pto_probe_policy pto_probe_policy;
+  /**
+   * :member:`crypto_offload`, if set to nonzero, makes the packet
+   * writing functions leave the payload encryption and header
+   * protection of 1RTT packets to a NIC or a kernel which performs
+   * them inline on transmit.  The packets are described by the
+   * offload fields of :type:`ngtcp2_pkt_info`, which is only
+   * available since :macro:`NGTCP2_PKT_INFO_VERSION_V3`.  If the
+   * packet writing function is called without
+   * :type:`ngtcp2_pkt_info` of that version, the packets are
+   * protected by the library as usual.  The keys are passed to
+   * :member:`ngtcp2_callbacks.offload_tx_key`.  Long header packets,
+   * and 1RTT packets which are not written along with the
+   * application data (e.g., the packets containing PATH_CHALLENGE,
+   * PATH_RESPONSE, CONNECTION_CLOSE, or PMTUD probe), are always
+   * protected by the library.
+   */
+  uint8_t crypto_offload;
+  /**
+   * :member:`coalesce_flow_control_update`, if set to nonzero, makes
+   * the connection hold MAX_DATA and MAX_STREAM_DATA frames for up
+   * to a quarter of smoothed RTT, so that the updates for many
+   * streams are sent together in fewer packets.  The held frames are
+   * sent without delay along with an ACK frame or the application
+   * data if there is any to send, or if the remote endpoint is left
+   * with less than a quarter of the flow control window of the
+   * connection or a stream.
+   */
+  int coalesce_flow_control_update;
+  /**
+   * :member:`pmtud_probe_data`, if set to nonzero, makes Path MTU
+   * Discovery probe packets carry the stream data, and the other
+   * retransmittable frames which are waiting to be sent, instead of
+   * being filled with PADDING only.  If a probe is lost, its frames
+   * are retransmitted as usual, and the loss is not regarded as a
+   * sign of congestion.  If there is nothing to send, the probe is
+   * made of PING and PADDING as usual.
+   */
+  int pmtud_probe_data;
+  /**
+   * :member:`retransmit_first`, if set to nonzero, makes the
+   * connection send the lost stream data of all streams before any
+   * new data.  While the lost stream data remain, neither new stream
+   * data nor DATAGRAM frames are written to a packet, and the queued
+   * DATAGRAM frames wait until the lost stream data have been sent.
+   * This bounds how long the remote endpoint waits for the missing
+   * data to deliver a stream in order.
+   */
+  int retransmit_first;
+  /**
+   * :member:`handshake_first` only applies to a server.  If it is set
+   * to nonzero, before the client address is validated, the server
+   * leaves the bytes of the Initial and Handshake packets in flight
+   * out of the amplification limit budget that 1-RTT packets can
+   * use, and sends no 1-RTT packet while Initial or Handshake CRYPTO
+   * data are waiting to be sent.  The server then spends its budget
+   * on ACK, Handshake CRYPTO, and 1-RTT in this order, and is able to
+   * retransmit the lost handshake packets without waiting for the
+   * client to send more bytes.
+   */
+  int handshake_first;
+  /**
+   * :member:`cwnd_validation`, if set to nonzero, enables congestion
+   * window validation (:rfc:`7661`) in Reno, CUBIC, and Prague.  The
+   * congestion window does not grow on the acknowledgement of a
+   * packet sent while app-limited, unless at least the half of it
+   * has been used recently.  It prevents the congestion window of
+   * an application which sends little data from growing to the size
+   * it has never used.  It has no effect while the connection is
+   * cwnd-limited.  When the application resumes sending while the
+   * congestion window is not validated, the burst is limited to the
+   * initial window until it is validated again.
+   */
+  int cwnd_validation;
+} ngtcp2_settings;
+
+
+#ifdef NGTCP2_USE_GENERIC_SOCKADDR
+typedef struct ngtcp2_sockaddr {
+  uint16_t sa_family;
+  uint8_t sa_data[14];
+} ngtcp2_sockaddr;
+
+typedef struct ngtcp2_in_addr {
+  uint32_t s_addr;
+} ngtcp2_in_addr;
+
+typedef struct ngtcp2_sockaddr_in {
+  uint16_t sin_family;
+  uint16_t sin_port;
+  ngtcp2_in_addr sin_addr;
+  uint8_t sin_zero[8];
+} ngtcp2_sockaddr_in;
+
+#  define NGTCP2_SS_MAXSIZE 128
+#  define NGTCP2_SS_ALIGNSIZE (sizeof(uint64_t))
+#  define NGTCP2_SS_PAD1SIZE (NGTCP2_SS_ALIGNSIZE - sizeof(uint16_t))
+#  define NGTCP2_SS_PAD2SIZE                                                   \
+    (NGTCP2_SS_MAXSIZE -                                                       \
+     (sizeof(uint16_t) + NGTCP2_SS_PAD1SIZE + NGTCP2_SS_ALIGNSIZE))
+
+typedef struct ngtcp2_sockaddr_storage {
+  uint16_t ss_family;
+  uint8_t _ss_pad1[NGTCP2_SS_PAD1SIZE];
+  uint64_t _ss_align;
+  uint8_t _ss_pad2[NGTCP2_SS_PAD2SIZE];
+} ngtcp2_sockaddr_storage;
+
+#  undef NGTCP2_SS_PAD2SIZE
+#  undef NGTCP2_SS_PAD1SIZE
+#  undef NGTCP2_SS_ALIGNSIZE
+#  undef NGTCP2_SS_MAXSIZE
 
+typedef uint32_t ngtcp2_socklen;
+#else
 /**
- * @function
+ * @typedef
  *
- * `ngtcp2_pkt_decode_version_cid` extracts QUIC version, Destination
- * Connection ID and Source Connection ID from the packet pointed by
- * |data| of length |datalen|.  This function can handle Connection ID
- * up to 255 bytes unlike `ngtcp2_pkt_decode_hd_long` or
- * `ngtcp2_pkt_decode_hd_short` which are only capable of handling
- * Connection ID less than or equal to :macro:`NGTCP2_MAX_CIDLEN`.
- * Longer Connection ID is only valid if the version is unsupported
- * QUIC version.
+ * :type:`ngtcp2_sockaddr` is typedefed to struct sockaddr.  If
+ * :macro:`NGTCP2_USE_GENERIC_SOCKADDR` is defined, it is typedefed to
+ * the generic struct sockaddr defined in ngtcp2.h.
+ */
+typedef struct sockaddr ngtcp2_sockaddr;
+/**
+ * @typedef
  *
- * If the given packet is Long header packet, this function extracts
- * the version from the packet and assigns it to
- * :member:`dest->version <ngtcp2_version_cid.version>`.  It also
- * extracts the pointer to the Destination Connection ID and its
- * length and assigns them to :member:`dest->dcid
- * <ngtcp2_version_cid.dcid>` and :member:`dest->dcidlen
- * <ngtcp2_version_cid.dcidlen>` respectively.  Similarly, it extracts
- * the pointer to the Source Connection ID and its length and assigns
- * them to :member:`dest->scid <ngtcp2_version_cid.scid>` and
- * :member:`dest->scidlen <ngtcp2_version_cid.scidlen>` respectively.
- *
- * If the given packet is Short header packet, :member:`dest->version
- * <ngtcp2_version_cid.version>` will be 0, :member:`dest->scid
- * <ngtcp2_version_cid.scid>` will be ``NULL``, and
- * :member:`dest->scidlen <ngtcp2_version_cid.scidlen>` will be 0.
- * Because the Short header packet does not have the length of
- * Destination Connection ID, the caller has to pass the length in
- * |short_dcidlen|.  This function extracts the pointer to the
- * Destination Connection ID and assigns it to :member:`dest->dcid
- * <ngtcp2_version_cid.dcid>`.  |short_dcidlen| is assigned to
- * :member:`dest->dcidlen <ngtcp2_version_cid.dcidlen>`.
- *
- * If Version Negotiation is required, this function returns
- * :macro:`NGTCP2_ERR_VERSION_NEGOTIATION`.  Unlike the other error
- * cases, all fields of |dest| are assigned as described above.
- *
- * This function returns 0 if it succeeds.  Otherwise, one of the
- * following negative error code:
- *
- * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
- *     The function could not decode the packet header.
- * :macro:`NGTCP2_ERR_VERSION_NEGOTIATION`
- *     Version Negotiation packet should be sent.
+ * :type:`ngtcp2_sockaddr_storage` is typedefed to struct
+ * sockaddr_storage.  If :macro:`NGTCP2_USE_GENERIC_SOCKADDR` is
+ * defined, it is typedefed to the generic struct sockaddr_storage
+ * defined in ngtcp2.h.
  */
-NGTCP2_EXTERN int ngtcp2_pkt_decode_version_cid(ngtcp2_version_cid *dest,
-                                                const uint8_t *data,
-                                                size_t datalen,
-                                                size_t short_dcidlen);
-
+typedef struct sockaddr_storage ngtcp2_sockaddr_storage;
+typedef struct sockaddr_in ngtcp2_sockaddr_in;
 /**
- * @function
- *
- * `ngtcp2_pkt_decode_hd_long` decodes QUIC long packet header in
- * |pkt| of length |pktlen|.  This function only parses the input just
- * before packet number field.
- *
- * This function does not verify that length field is correct.  In
- * other words, this function succeeds even if length > |pktlen|.
- *
- * This function can handle Connection ID up to
- * :macro:`NGTCP2_MAX_CIDLEN`.  Consider to use
- * `ngtcp2_pkt_decode_version_cid` to get longer Connection ID.
- *
- * This function handles Version Negotiation specially.  If version
- * field is 0, |pkt| must contain Version Negotiation packet.  Version
- * Negotiation packet has random type in wire format.  For
- * convenience, this function sets
- * :enum:`ngtcp2_pkt_type.NGTCP2_PKT_VERSION_NEGOTIATION` to
- * :member:`dest->type <ngtcp2_pkt_hd.type>`, clears
- * :macro:`NGTCP2_PKT_FLAG_LONG_FORM` flag from :member:`dest->flags
- * <ngtcp2_pkt_hd.flags>`, and sets 0 to :member:`dest->len
- * <ngtcp2_pkt_hd.len>`.  Version Negotiation packet occupies a single
- * packet.
- *
- * It stores the result in the object pointed by |dest|, and returns
- * the number of bytes decoded to read the packet header if it
- * succeeds, or one of the following error codes:
+ * @typedef
  *
- * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
- *     Packet is too short; or it is not a long header
+ * :type:`ngtcp2_socklen` is typedefed to socklen_t.  If
+ * :macro:`NGTCP2_USE_GENERIC_SOCKADDR` is defined, it is typedefed to
+ * uint32_t.
  */
-NGTCP2_EXTERN ngtcp2_ssize ngtcp2_pkt_decode_hd_long(ngtcp2_pkt_hd *dest,
-                                                     const uint8_t *pkt,
-                                                     size_t pktlen);
+typedef socklen_t ngtcp2_socklen;
+#endif
 
-/**
- * @function
- *
- * `ngtcp2_pkt_decode_hd_short` decodes QUIC short header packet
- * header in |pkt| of length |pktlen|.  |dcidlen| is the length of
- * DCID in packet header.  Short header packet does not encode the
- * length of connection ID, thus we need the input from the outside.
- * This function only parses the input just before packet number
- * field.  This function can handle Connection ID up to
- * :macro:`NGTCP2_MAX_CIDLEN`.  Consider to use
- * `ngtcp2_pkt_decode_version_cid` to get longer Connection ID.  It
- * stores the result in the object pointed by |dest|, and returns the
- * number of bytes decoded to read the packet header if it succeeds,
- * or one of the following error codes:
- *
- * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
- *     Packet is too short; or it is not a short header
- */
-NGTCP2_EXTERN ngtcp2_ssize ngtcp2_pkt_decode_hd_short(ngtcp2_pkt_hd *dest,
-                                                      const uint8_t *pkt,
-                                                      size_t pktlen,
-                                                      size_t dcidlen);
+#if defined(NGTCP2_USE_GENERIC_SOCKADDR) ||                                    \
+    defined(NGTCP2_USE_GENERIC_IPV6_SOCKADDR)
+typedef struct ngtcp2_in6_addr {
+  uint8_t in6_addr[16];
+} ngtcp2_in6_addr;
+
+typedef struct ngtcp2_sockaddr_in6 {
+  uint16_t sin6_family;
+  uint16_t sin6_port;
+  uint32_t sin6_flowinfo;
+  ngtcp2_in6_addr sin6_addr;
+  uint32_t sin6_scope_id;
+} ngtcp2_sockaddr_in6;
+#else
+typedef struct sockaddr_in6 ngtcp2_sockaddr_in6;
+#endif
 
 /**
- * @function
- *
- * `ngtcp2_pkt_write_stateless_reset` writes Stateless Reset packet in
- * the buffer pointed by |dest| whose length is |destlen|.
- * |stateless_reset_token| is a pointer to the Stateless Reset Token,
- * and its length must be :macro:`NGTCP2_STATELESS_RESET_TOKENLEN`
- * bytes long.  |rand| specifies the random octets preceding Stateless
- * Reset Token.  The length of |rand| is specified by |randlen| which
- * must be at least :macro:`NGTCP2_MIN_STATELESS_RESET_RANDLEN` bytes
- * long.
- *
- * If |randlen| is too long to write them all in the buffer, |rand| is
- * written to the buffer as much as possible, and is truncated.
- *
- * This function returns the number of bytes written to the buffer, or
- * one of the following negative error codes:
+ * @struct
  *
- * :macro:`NGTCP2_ERR_NOBUF`
- *     Buffer is too small.
- * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
- *     |randlen| is strictly less than
- *     :macro:`NGTCP2_MIN_STATELESS_RESET_RANDLEN`.
+ * :type:`ngtcp2_addr` is the endpoint address.
  */
-NGTCP2_EXTERN ngtcp2_ssize ngtcp2_pkt_write_stateless_reset(
-    uint8_t *dest, size_t destlen, const uint8_t *stateless_reset_token,
-    const uint8_t *rand, size_t randlen);
+typedef struct ngtcp2_addr {
+  /**
+   * :member:`addr` points to the buffer which contains endpoint
+   * address.  It must not be ``NULL``.
+   */
+  ngtcp2_sockaddr *addr;
+  /**
+   * :member:`addrlen` is the length of addr.
+   */
+  ngtcp2_socklen addrlen;
+} ngtcp2_addr;
 
 /**
- * @function
- *
- * `ngtcp2_pkt_write_version_negotiation` writes Version Negotiation
- * packet in the buffer pointed by |dest| whose length is |destlen|.
- * |unused_random| should be generated randomly.  |dcid| is the
- * destination connection ID which appears in a packet as a source
- * connection ID sent by client which caused version negotiation.
- * Similarly, |scid| is the source connection ID which appears in a
- * packet as a destination connection ID sent by client.  |sv| is a
- * list of supported versions, and |nsv| specifies the number of
- * supported versions included in |sv|.
- *
- * This function returns the number of bytes written to the buffer, or
- * one of the following negative error codes:
+ * @struct
  *
- * :macro:`NGTCP2_ERR_NOBUF`
- *     Buffer is too small.
+ * :type:`ngtcp2_path` is the network endpoints where a packet is sent
+ * and received.
  */
-NGTCP2_EXTERN ngtcp2_ssize ngtcp2_pkt_write_version_negotiation(
-    uint8_t *dest, size_t destlen, uint8_t unused_random, const uint8_t *dcid,
-    size_t dcidlen, const uint8_t *scid, size_t scidlen, const uint32_t *sv,
-    size_t nsv);
+typedef struct ngtcp2_path {
+  /**
+   * :member:`local` is the address of local endpoint.
+   */
+  ngtcp2_addr local;
+  /**
+   * :member:`remote` is the address of remote endpoint.
+   */
+  ngtcp2_addr remote;
+  /**
+   * :member:`user_data` is an arbitrary data and opaque to the
+   * library.
+   *
+   * Note that :type:`ngtcp2_path` is generally passed to
+   * :type:`ngtcp2_conn` by an application, and :type:`ngtcp2_conn`
+   * stores their copies.  Unfortunately, there is no way for the
+   * application to know when :type:`ngtcp2_conn` finishes using a
+   * specific :type:`ngtcp2_path` object in mid connection, which
+   * means that the application cannot free the data pointed by this
+   * field.  Therefore, it is advised to use this field only when the
+   * data pointed by this field persists in an entire lifetime of the
+   * connection.
+   */
+  void *user_data;
+} ngtcp2_path;
 
 /**
  * @struct
  *
- * :type:`ngtcp2_conn` represents a single QUIC connection.
+ * :type:`ngtcp2_path_storage` is a convenient struct to have buffers
+ * to store the longest addresses.
  */
-typedef struct ngtcp2_conn ngtcp2_conn;
+typedef struct ngtcp2_path_storage {
+  /**
+   * :member:`path` stores network path.
+   */
+  ngtcp2_path path;
+  /**
+   * :member:`local_addrbuf` is a buffer to store local address.
+   */
+  ngtcp2_sockaddr_storage local_addrbuf;
+  /**
+   * :member:`remote_addrbuf` is a buffer to store remote address.
+   */
+  ngtcp2_sockaddr_storage remote_addrbuf;
+} ngtcp2_path_storage;
 
 /**
- * @functypedef
- *
- * :type:`ngtcp2_client_initial` is invoked when client application
- * asks TLS stack to produce first TLS cryptographic handshake data.
- *
- * This implementation of this callback must get the first handshake
- * data from TLS stack and pass it to ngtcp2 library using
- * `ngtcp2_conn_submit_crypto_data` function.  Make sure that before
- * calling `ngtcp2_conn_submit_crypto_data` function, client
- * application must create initial packet protection keys and IVs, and
- * provide them to ngtcp2 library using
- * `ngtcp2_conn_install_initial_key`.
+ * @enum
  *
- * This callback function must return 0 if it succeeds, or
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library call
- * return immediately.
+ * :type:`ngtcp2_path_role` identifies a network path of a connection
+ * by the role which it plays.
  */
-typedef int (*ngtcp2_client_initial)(ngtcp2_conn *conn, void *user_data);
+typedef enum ngtcp2_path_role {
+  /**
+   * :enum:`NGTCP2_PATH_ROLE_ACTIVE` is the path which the connection
+   * currently uses to send packets.
+   */
+  NGTCP2_PATH_ROLE_ACTIVE,
+  /**
+   * :enum:`NGTCP2_PATH_ROLE_FALLBACK` is the path which the
+   * connection goes back to if the validation of the active path
+   * fails after the remote endpoint migrated to it.
+   */
+  NGTCP2_PATH_ROLE_FALLBACK,
+  /**
+   * :enum:`NGTCP2_PATH_ROLE_PROBING` is the path which is being
+   * validated.  It may be the same path as the active path.
+   */
+  NGTCP2_PATH_ROLE_PROBING
+} ngtcp2_path_role;
+
+#define NGTCP2_PATH_STAT_V1 1
+#define NGTCP2_PATH_STAT_VERSION NGTCP2_PATH_STAT_V1
 
 /**
- * @functypedef
- *
- * :type:`ngtcp2_recv_client_initial` is invoked when server receives
- * Initial packet from client.  An server application must implement
- * this callback, and generate initial keys and IVs for both
- * transmission and reception.  Install them using
- * `ngtcp2_conn_install_initial_key`.  |dcid| is the destination
- * connection ID which client generated randomly.  It is used to
- * derive initial packet protection keys.
+ * @struct
  *
- * The callback function must return 0 if it succeeds.  If an error
- * occurs, return :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the
- * library call return immediately.
- */
-typedef int (*ngtcp2_recv_client_initial)(ngtcp2_conn *conn,
-                                          const ngtcp2_cid *dcid,
-                                          void *user_data);
-
-/**
- * @enum
- *
- * :type:`ngtcp2_crypto_level` is encryption level.
+ * :type:`ngtcp2_path_stat` holds the statistics of a network path.
  */
-typedef enum ngtcp2_crypto_level {
+typedef struct ngtcp2_path_stat {
   /**
-   * :enum:`NGTCP2_CRYPTO_LEVEL_INITIAL` is Initial Keys encryption
-   * level.
+   * :member:`path` is the network path.  The addresses point to the
+   * buffers owned by :type:`ngtcp2_conn`, and they are only valid
+   * until the connection is modified.
    */
-  NGTCP2_CRYPTO_LEVEL_INITIAL,
+  ngtcp2_path path;
   /**
-   * :enum:`NGTCP2_CRYPTO_LEVEL_HANDSHAKE` is Handshake Keys
-   * encryption level.
+   * :member:`latest_rtt` is the latest RTT sample measured on the
+   * path.  It is 0 if RTT has not been measured.  The RTT of a path
+   * other than the active path is measured by path validation, or it
+   * is the one measured while the path was active.
    */
-  NGTCP2_CRYPTO_LEVEL_HANDSHAKE,
+  ngtcp2_duration latest_rtt;
   /**
-   * :enum:`NGTCP2_CRYPTO_LEVEL_APPLICATION` is Application Data
-   * (1-RTT) Keys encryption level.
+   * :member:`min_rtt` is the minimum RTT measured on the path.  It is
+   * UINT64_MAX if RTT has not been measured.
    */
-  NGTCP2_CRYPTO_LEVEL_APPLICATION,
+  ngtcp2_duration min_rtt;
   /**
-   * :enum:`NGTCP2_CRYPTO_LEVEL_EARLY` is Early Data (0-RTT) Keys
-   * encryption level.
+   * :member:`smoothed_rtt` is the smoothed RTT of the path.  It is 0
+   * if RTT has not been measured.
    */
-  NGTCP2_CRYPTO_LEVEL_EARLY
-} ngtcp2_crypto_level;
+  ngtcp2_duration smoothed_rtt;
+  /**
+   * :member:`lost_pkt_count` is the number of packets declared lost
+   * while the path was the active path.
+   */
+  uint64_t lost_pkt_count;
+  /**
+   * :member:`bytes_sent` is the number of bytes sent to the path.
+   */
+  uint64_t bytes_sent;
+  /**
+   * :member:`bytes_recv` is the number of bytes received from the
+   * path.
+   */
+  uint64_t bytes_recv;
+  /**
+   * :member:`max_udp_payload_size` is the maximum UDP payload size
+   * which is allowed to be sent to the path.
+   */
+  size_t max_udp_payload_size;
+  /**
+   * :member:`validation_start_ts` is the timestamp when the ongoing
+   * path validation of the path started.  It is UINT64_MAX if the
+   * path is not being validated.
+   */
+  ngtcp2_tstamp validation_start_ts;
+  /**
+   * :member:`validated_ts` is the timestamp when the path was
+   * validated.  It is UINT64_MAX if the path has not been validated,
+   * or if the path is regarded as validated without path validation
+   * (e.g., the path which the client uses to establish the
+   * connection).
+   */
+  ngtcp2_tstamp validated_ts;
+  /**
+   * :member:`validated` is nonzero if the path has been validated.
+   */
+  int validated;
+} ngtcp2_path_stat;
 
 /**
- * @functypedef
- *
- * :type`ngtcp2_recv_crypto_data` is invoked when crypto data is
- * received.  The received data is pointed to by |data|, and its
- * length is |datalen|.  The |offset| specifies the offset where
- * |data| is positioned.  |user_data| is the arbitrary pointer passed
- * to `ngtcp2_conn_client_new` or `ngtcp2_conn_server_new`.  The
- * ngtcp2 library ensures that the crypto data is passed to the
- * application in the increasing order of |offset|.  |datalen| is
- * always strictly greater than 0.  |crypto_level| indicates the
- * encryption level where this data is received.  Crypto data can
- * never be received in
- * :enum:`ngtcp2_crypto_level.NGTCP2_CRYPTO_LEVEL_EARLY`.
- *
- * The application should provide the given data to TLS stack.
- *
- * The callback function must return 0 if it succeeds, or one of the
- * following negative error codes:
- *
- * - :macro:`NGTCP2_ERR_CRYPTO`
- * - :macro:`NGTCP2_ERR_REQUIRED_TRANSPORT_PARAM`
- * - :macro:`NGTCP2_ERR_MALFORMED_TRANSPORT_PARAM`
- * - :macro:`NGTCP2_ERR_TRANSPORT_PARAM`
- * - :macro:`NGTCP2_ERR_PROTO`
- * - :macro:`NGTCP2_ERR_VERSION_NEGOTIATION_FAILURE`
- * - :macro:`NGTCP2_ERR_NOMEM`
- * - :macro:`NGTCP2_ERR_CALLBACK_FAILURE`
- *
- * If the other value is returned, it is treated as
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`.
+ * @struct
  *
- * If application encounters fatal error, return
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library call
- * return immediately.
+ * :type:`ngtcp2_crypto_md` is a wrapper around native message digest
+ * object.
  */
-typedef int (*ngtcp2_recv_crypto_data)(ngtcp2_conn *conn,
-                                       ngtcp2_crypto_level crypto_level,
-                                       uint64_t offset, const uint8_t *data,
-                                       size_t datalen, void *user_data);
+typedef struct ngtcp2_crypto_md {
+  /**
+   * :member:`native_handle` is a pointer to an underlying message
+   * digest object.
+   */
+  void *native_handle;
+} ngtcp2_crypto_md;
 
 /**
- * @functypedef
- *
- * :type:`ngtcp2_handshake_completed` is invoked when QUIC
- * cryptographic handshake has completed.
+ * @struct
  *
- * The callback function must return 0 if it succeeds.  Returning
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
- * immediately.
+ * :type:`ngtcp2_crypto_aead` is a wrapper around native AEAD object.
  */
-typedef int (*ngtcp2_handshake_completed)(ngtcp2_conn *conn, void *user_data);
+typedef struct ngtcp2_crypto_aead {
+  /**
+   * :member:`native_handle` is a pointer to an underlying AEAD
+   * object.
+   */
+  void *native_handle;
+  /**
+   * :member:`max_overhead` is the number of additional bytes which
+   * AEAD encryption needs on encryption.
+   */
+  size_t max_overhead;
+} ngtcp2_crypto_aead;
 
 /**
- * @functypedef
- *
- * :type:`ngtcp2_handshake_confirmed` is invoked when QUIC
- * cryptographic handshake is confirmed.  The handshake confirmation
- * means that both endpoints agree that handshake has finished.
+ * @struct
  *
- * The callback function must return 0 if it succeeds.  Returning
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
- * immediately.
+ * :type:`ngtcp2_crypto_cipher` is a wrapper around native cipher
+ * object.
  */
-typedef int (*ngtcp2_handshake_confirmed)(ngtcp2_conn *conn, void *user_data);
+typedef struct ngtcp2_crypto_cipher {
+  /**
+   * :member:`native_handle` is a pointer to an underlying cipher
+   * object.
+   */
+  void *native_handle;
+} ngtcp2_crypto_cipher;
 
 /**
- * @functypedef
- *
- * :type:`ngtcp2_recv_version_negotiation` is invoked when Version
- * Negotiation packet is received.  |hd| is the pointer to the QUIC
- * packet header object.  The vector |sv| of |nsv| elements contains
- * the QUIC version the server supports.  Since Version Negotiation is
- * only sent by server, this callback function is used by client only.
+ * @struct
  *
- * The callback function must return 0 if it succeeds, or
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library call
- * return immediately.
+ * :type:`ngtcp2_crypto_aead_ctx` is a wrapper around native AEAD
+ * cipher context object.  It should be initialized with a specific
+ * key.  ngtcp2 library reuses this context object to encrypt or
+ * decrypt multiple packets.
  */
-typedef int (*ngtcp2_recv_version_negotiation)(ngtcp2_conn *conn,
-                                               const ngtcp2_pkt_hd *hd,
-                                               const uint32_t *sv, size_t nsv,
-                                               void *user_data);
+typedef struct ngtcp2_crypto_aead_ctx {
+  /**
+   * :member:`native_handle` is a pointer to an underlying AEAD
+   * context object.
+   */
+  void *native_handle;
+} ngtcp2_crypto_aead_ctx;
 
 /**
- * @functypedef
- *
- * :type:`ngtcp2_recv_retry` is invoked when Retry packet is received.
- * This callback is client use only.
- *
- * Application must regenerate packet protection key, IV, and header
- * protection key for Initial packets using the destination connection
- * ID obtained by :member:`hd->scid <ngtcp2_pkt_hd.scid>` and install
- * them by calling `ngtcp2_conn_install_initial_key()`.
+ * @struct
  *
- * 0-RTT data accepted by the ngtcp2 library will be automatically
- * retransmitted as 0-RTT data by the library.
+ * :type:`ngtcp2_crypto_cipher_ctx` is a wrapper around native cipher
+ * context object.  It should be initialized with a specific key.
+ * ngtcp2 library reuses this context object to encrypt or decrypt
+ * multiple packet headers.
+ */
+typedef struct ngtcp2_crypto_cipher_ctx {
+  /**
+   * :member:`native_handle` is a pointer to an underlying cipher
+   * context object.
+   */
+  void *native_handle;
+} ngtcp2_crypto_cipher_ctx;
+
+/**
+ * @struct
  *
- * The callback function must return 0 if it succeeds.  Returning
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
- * immediately.
+ * :type:`ngtcp2_crypto_ctx` is a convenient structure to bind all
+ * crypto related objects in one place.  Use
+ * `ngtcp2_crypto_ctx_initial` to initialize this struct for Initial
+ * packet encryption.  For Handshake and 1RTT packets, use
+ * `ngtcp2_crypto_ctx_tls`.
  */
-typedef int (*ngtcp2_recv_retry)(ngtcp2_conn *conn, const ngtcp2_pkt_hd *hd,
-                                 void *user_data);
+typedef struct ngtcp2_crypto_ctx {
+  /**
+   * :member:`aead` is AEAD object.
+   */
+  ngtcp2_crypto_aead aead;
+  /**
+   * :member:`md` is message digest object.
+   */
+  ngtcp2_crypto_md md;
+  /**
+   * :member:`hp` is header protection cipher.
+   */
+  ngtcp2_crypto_cipher hp;
+  /**
+   * :member:`max_encryption` is the number of encryption which this
+   * key can be used with.  After the handshake is confirmed, the
+   * library initiates key update automatically when the number of
+   * packets encrypted with the current 1RTT key reaches a point
+   * between 3/4 and 7/8 of this value, which is chosen randomly per
+   * connection.  If key update is not possible until this value is
+   * reached, :macro:`NGTCP2_ERR_AEAD_LIMIT_REACHED` is returned.
+   */
+  uint64_t max_encryption;
+  /**
+   * :member:`max_decryption_failure` is the number of decryption
+   * failure with this key.
+   */
+  uint64_t max_decryption_failure;
+} ngtcp2_crypto_ctx;
 
 /**
- * @functypedef
+ * @function
  *
- * :type:`ngtcp2_encrypt` is invoked when the ngtcp2 library asks the
- * application to encrypt packet payload.  The packet payload to
- * encrypt is passed as |plaintext| of length |plaintextlen|.  The
- * AEAD cipher is |aead|.  |aead_ctx| is the AEAD cipher context
- * object which is initialized with encryption key.  The nonce is
- * passed as |nonce| of length |noncelen|.  The Additional
- * Authenticated Data is passed as |aad| of length |aadlen|.
+ * `ngtcp2_encode_transport_params` encodes |params| in |dest| of
+ * length |destlen|.
  *
- * The implementation of this callback must encrypt |plaintext| using
- * the negotiated cipher suite and write the ciphertext into the
- * buffer pointed by |dest|.  |dest| has enough capacity to store the
- * ciphertext and any additional AEAD tag data.
+ * If |dest| is NULL, and |destlen| is zero, this function just
+ * returns the number of bytes required to store the encoded transport
+ * parameters.
  *
- * |dest| and |plaintext| may point to the same buffer.
+ * This function returns the number of written, or one of the
+ * following negative error codes:
  *
- * The callback function must return 0 if it succeeds, or
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library call
- * return immediately.
+ * :macro:`NGTCP2_ERR_NOBUF`
+ *     Buffer is too small.
+ * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     |exttype| is invalid.
  */
-typedef int (*ngtcp2_encrypt)(uint8_t *dest, const ngtcp2_crypto_aead *aead,
-                              const ngtcp2_crypto_aead_ctx *aead_ctx,
-                              const uint8_t *plaintext, size_t plaintextlen,
-                              const uint8_t *nonce, size_t noncelen,
-                              const uint8_t *aad, size_t aadlen);
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_encode_transport_params_versioned(
+    uint8_t *dest, size_t destlen, ngtcp2_transport_params_type exttype,
+    int transport_params_version, const ngtcp2_transport_params *params);
 
 /**
- * @functypedef
+ * @function
  *
- * :type:`ngtcp2_decrypt` is invoked when the ngtcp2 library asks the
- * application to decrypt packet payload.  The packet payload to
- * decrypt is passed as |ciphertext| of length |ciphertextlen|.  The
- * AEAD cipher is |aead|.  |aead_ctx| is the AEAD cipher context
- * object which is initialized with decryption key.  The nonce is
- * passed as |nonce| of length |noncelen|.  The Additional
- * Authenticated Data is passed as |aad| of length |aadlen|.
- *
- * The implementation of this callback must decrypt |ciphertext| using
- * the negotiated cipher suite and write the ciphertext into the
- * buffer pointed by |dest|.  |dest| has enough capacity to store the
- * cleartext.
- *
- * |dest| and |ciphertext| may point to the same buffer.
- *
- * The callback function must return 0 if it succeeds.  If TLS stack
- * fails to decrypt data, return :macro:`NGTCP2_ERR_DECRYPT`.  For any
- * other errors, return :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which
- * makes the library call return immediately.
+ * `ngtcp2_transport_params_template_init` encodes the transport
+ * parameters in |params| which do not depend on a particular
+ * connection, and stores them in |tmpl|.  The fields which are
+ * specific to a connection, that is original_dcid, initial_scid,
+ * retry_scid, stateless_reset_token, preferred_address, and
+ * version_info, are ignored.
  */
-typedef int (*ngtcp2_decrypt)(uint8_t *dest, const ngtcp2_crypto_aead *aead,
-                              const ngtcp2_crypto_aead_ctx *aead_ctx,
-                              const uint8_t *ciphertext, size_t ciphertextlen,
-                              const uint8_t *nonce, size_t noncelen,
-                              const uint8_t *aad, size_t aadlen);
+NGTCP2_EXTERN void ngtcp2_transport_params_template_init(
+    ngtcp2_transport_params_template *tmpl,
+    const ngtcp2_transport_params *params);
 
 /**
- * @functypedef
+ * @function
  *
- * :type:`ngtcp2_hp_mask` is invoked when the ngtcp2 library asks the
- * application to produce a mask to encrypt or decrypt packet header.
- * The encryption cipher is |hp|.  |hp_ctx| is the cipher context
- * object which is initialized with header protection key.  The sample
- * is passed as |sample| which is :macro:`NGTCP2_HP_SAMPLELEN` bytes
- * long.
+ * `ngtcp2_decode_transport_params` decodes transport parameters in
+ * |data| of length |datalen|, and stores the result in the object
+ * pointed by |params|.
  *
- * The implementation of this callback must produce a mask using the
- * header protection cipher suite specified by QUIC specification and
- * write the result into the buffer pointed by |dest|.  The length of
- * the mask must be at least :macro:`NGTCP2_HP_MASKLEN`.  The library
- * only uses the first :macro:`NGTCP2_HP_MASKLEN` bytes of the
- * produced mask.  The buffer pointed by |dest| is guaranteed to have
- * at least :macro:`NGTCP2_HP_SAMPLELEN` bytes available for
- * convenience.
+ * If the optional parameters are missing, the default value is
+ * assigned.
  *
- * The callback function must return 0 if it succeeds, or
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library call
- * return immediately.
- */
-typedef int (*ngtcp2_hp_mask)(uint8_t *dest, const ngtcp2_crypto_cipher *hp,
-                              const ngtcp2_crypto_cipher_ctx *hp_ctx,
-                              const uint8_t *sample);
-
-/**
- * @macrosection
+ * The following fields may point to somewhere inside the buffer
+ * pointed by |data| of length |datalen|:
  *
- * Stream data flags
+ * - :member:`ngtcp2_transport_params.version_info.other_versions
+ *   <ngtcp2_version_info.other_versions>`
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_REQUIRED_TRANSPORT_PARAM`
+ *     The required parameter is missing.
+ * :macro:`NGTCP2_ERR_MALFORMED_TRANSPORT_PARAM`
+ *     The input is malformed.
  */
+NGTCP2_EXTERN int ngtcp2_decode_transport_params_versioned(
+    int transport_params_version, ngtcp2_transport_params *params,
+    ngtcp2_transport_params_type exttype, const uint8_t *data, size_t datalen);
 
 /**
- * @macro
+ * @function
  *
- * :macro:`NGTCP2_STREAM_DATA_FLAG_NONE` indicates no flag set.
+ * `ngtcp2_decode_transport_params_new` decodes transport parameters
+ * in |data| of length |datalen|, and stores the result in the object
+ * allocated dynamically.  The pointer to the allocated object is
+ * assigned to |*pparams|.  Unlike `ngtcp2_decode_transport_params`,
+ * all direct and indirect fields are also allocated dynamically if
+ * needed.
+ *
+ * |mem| is a memory allocator to allocate memory.  If |mem| is
+ * ``NULL``, the memory allocator returned by `ngtcp2_mem_default()`
+ * is used.
+ *
+ * If the optional parameters are missing, the default value is
+ * assigned.
+ *
+ * `ngtcp2_transport_params_del` frees the memory allocated by this
+ * function.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_REQUIRED_TRANSPORT_PARAM`
+ *     The required parameter is missing.
+ * :macro:`NGTCP2_ERR_MALFORMED_TRANSPORT_PARAM`
+ *     The input is malformed.
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
  */
-#define NGTCP2_STREAM_DATA_FLAG_NONE 0x00u
+NGTCP2_EXTERN int ngtcp2_decode_transport_params_new(
+    ngtcp2_transport_params **pparams, ngtcp2_transport_params_type exttype,
+    const uint8_t *data, size_t datalen, const ngtcp2_mem *mem);
 
 /**
- * @macro
+ * @function
  *
- * :macro:`NGTCP2_STREAM_DATA_FLAG_FIN` indicates that this chunk of
- * data is final piece of an incoming stream.
+ * `ngtcp2_transport_params_del` frees the |params| which must be
+ * dynamically allocated by `ngtcp2_decode_transport_params_new`.
+ *
+ * |mem| is a memory allocator that allocated |params|.  If |mem| is
+ * ``NULL``, the memory allocator returned by `ngtcp2_mem_default()`
+ * is used.
+ *
+ * If |params| is ``NULL``, this function does nothing.
  */
-#define NGTCP2_STREAM_DATA_FLAG_FIN 0x01u
+NGTCP2_EXTERN void ngtcp2_transport_params_del(ngtcp2_transport_params *params,
+                                               const ngtcp2_mem *mem);
 
 /**
- * @macro
+ * @struct
  *
- * :macro:`NGTCP2_STREAM_DATA_FLAG_EARLY` indicates that this chunk of
- * data contains data received in 0RTT packet and the handshake has
- * not completed yet, which means that the data might be replayed.
+ * :type:`ngtcp2_version_cid` is a convenient struct to store the
+ * result of `ngtcp2_pkt_decode_version_cid`.
  */
-#define NGTCP2_STREAM_DATA_FLAG_EARLY 0x02u
+typedef struct ngtcp2_version_cid {
+  /**
+   * :member:`version` stores QUIC version.
+   */
+  uint32_t version;
+  /**
+   * :member:`dcid` points to the Destination Connection ID.
+   */
+  const uint8_t *dcid;
+  /**
+   * :member:`dcidlen` is the length of the Destination Connection ID
+   * pointed by :member:`dcid`.
+   */
+  size_t dcidlen;
+  /**
+   * :member:`scid` points to the Source Connection ID.
+   */
+  const uint8_t *scid;
+  /**
+   * :member:`scidlen` is the length of the Source Connection ID
+   * pointed by :member:`scid`.
+   */
+  size_t scidlen;
+} ngtcp2_version_cid;
 
 /**
- * @functypedef
+ * @function
  *
- * :type:`ngtcp2_recv_stream_data` is invoked when stream data is
- * received.  The stream is specified by |stream_id|.  |flags| is the
- * bitwise-OR of zero or more of :macro:`NGTCP2_STREAM_DATA_FLAG_*
- * <NGTCP2_STREAM_DATA_FLAG_NONE>`.  If |flags| &
- * :macro:`NGTCP2_STREAM_DATA_FLAG_FIN` is nonzero, this portion of
- * the data is the last data in this stream.  |offset| is the offset
- * where this data begins.  The library ensures that data is passed to
- * the application in the non-decreasing order of |offset| without any
- * overlap.  The data is passed as |data| of length |datalen|.
- * |datalen| may be 0 if and only if |fin| is nonzero.
+ * `ngtcp2_pkt_decode_version_cid` extracts QUIC version, Destination
+ * Connection ID and Source Connection ID from the packet pointed by
+ * |data| of length |datalen|.  This function can handle Connection ID
+ * up to 255 bytes unlike `ngtcp2_pkt_decode_hd_long` or
+ * `ngtcp2_pkt_decode_hd_short` which are only capable of handling
+ * Connection ID less than or equal to :macro:`NGTCP2_MAX_CIDLEN`.
+ * Longer Connection ID is only valid if the version is unsupported
+ * QUIC version.
  *
- * If :macro:`NGTCP2_STREAM_DATA_FLAG_EARLY` is set in |flags|, it
- * indicates that a part of or whole data was received in 0RTT packet
- * and a handshake has not completed yet.
+ * If the given packet is Long header packet, this function extracts
+ * the version from the packet and assigns it to
+ * :member:`dest->version <ngtcp2_version_cid.version>`.  It also
+ * extracts the pointer to the Destination Connection ID and its
+ * length and assigns them to :member:`dest->dcid
+ * <ngtcp2_version_cid.dcid>` and :member:`dest->dcidlen
+ * <ngtcp2_version_cid.dcidlen>` respectively.  Similarly, it extracts
+ * the pointer to the Source Connection ID and its length and assigns
+ * them to :member:`dest->scid <ngtcp2_version_cid.scid>` and
+ * :member:`dest->scidlen <ngtcp2_version_cid.scidlen>` respectively.
  *
- * The callback function must return 0 if it succeeds, or
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library return
- * immediately.
- */
-typedef int (*ngtcp2_recv_stream_data)(ngtcp2_conn *conn, uint32_t flags,
-                                       int64_t stream_id, uint64_t offset,
-                                       const uint8_t *data, size_t datalen,
-                                       void *user_data, void *stream_user_data);
-
-/**
- * @functypedef
+ * If the given packet is Short header packet, :member:`dest->version
+ * <ngtcp2_version_cid.version>` will be 0, :member:`dest->scid
+ * <ngtcp2_version_cid.scid>` will be ``NULL``, and
+ * :member:`dest->scidlen <ngtcp2_version_cid.scidlen>` will be 0.
+ * Because the Short header packet does not have the length of
+ * Destination Connection ID, the caller has to pass the length in
+ * |short_dcidlen|.  This function extracts the pointer to the
+ * Destination Connection ID and assigns it to :member:`dest->dcid
+ * <ngtcp2_version_cid.dcid>`.  |short_dcidlen| is assigned to
+ * :member:`dest->dcidlen <ngtcp2_version_cid.dcidlen>`.
  *
- * :type:`ngtcp2_stream_open` is a callback function which is called
- * when remote stream is opened by peer.  This function is not called
- * if stream is opened by implicitly (we might reconsider this
- * behaviour).
+ * If Version Negotiation is required, this function returns
+ * :macro:`NGTCP2_ERR_VERSION_NEGOTIATION`.  Unlike the other error
+ * cases, all fields of |dest| are assigned as described above.
  *
- * The implementation of this callback should return 0 if it succeeds.
- * Returning :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library
- * call return immediately.
- */
-typedef int (*ngtcp2_stream_open)(ngtcp2_conn *conn, int64_t stream_id,
-                                  void *user_data);
-
-/**
- * @macrosection
+ * This function returns 0 if it succeeds.  Otherwise, one of the
+ * following negative error code:
  *
- * Stream close flags
+ * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     The function could not decode the packet header.
+ * :macro:`NGTCP2_ERR_VERSION_NEGOTIATION`
+ *     Version Negotiation packet should be sent.
  */
+NGTCP2_EXTERN int ngtcp2_pkt_decode_version_cid(ngtcp2_version_cid *dest,
+                                                const uint8_t *data,
+                                                size_t datalen,
+                                                size_t short_dcidlen);
 
 /**
- * @macro
+ * @struct
  *
- * :macro:`NGTCP2_STREAM_CLOSE_FLAG_NONE` indicates no flag set.
+ * :type:`ngtcp2_pkt_batch_entry` is a datagram in the batch which
+ * `ngtcp2_pkt_group_by_dcid` groups.
  */
-#define NGTCP2_STREAM_CLOSE_FLAG_NONE 0x00u
+typedef struct ngtcp2_pkt_batch_entry {
+  /**
+   * :member:`index` is the position of the datagram in the batch.
+   */
+  size_t index;
+  /**
+   * :member:`rv` is the return value of
+   * `ngtcp2_pkt_decode_version_cid` for the datagram.
+   */
+  int rv;
+  /**
+   * :member:`vc` is the result of `ngtcp2_pkt_decode_version_cid`
+   * for the datagram.  It is only valid if :member:`rv` is 0 or
+   * :macro:`NGTCP2_ERR_VERSION_NEGOTIATION`.
+   */
+  ngtcp2_version_cid vc;
+} ngtcp2_pkt_batch_entry;
 
 /**
- * @macro
+ * @function
  *
- * :macro:`NGTCP2_STREAM_CLOSE_FLAG_APP_ERROR_CODE_SET` indicates that
- * app_error_code parameter is set.
+ * `ngtcp2_pkt_group_by_dcid` decodes the first packet of each of |n|
+ * datagrams pointed by |dgrams| with `ngtcp2_pkt_decode_version_cid`
+ * and |short_dcidlen|, and writes the results to |dest|, which must
+ * have room for at least |n| entries.
+ *
+ * The entries are ordered so that the datagrams which have the same
+ * Destination Connection ID are adjacent.  The groups appear in the
+ * order of their first datagram in the batch, and the datagrams in a
+ * group keep their order in the batch, so that processing the entries
+ * in order does not reorder the packets of a connection.  A datagram
+ * which cannot be decoded forms a group by itself.
+ *
+ * This function is intended for a batch of datagrams received at once
+ * (e.g., by recvmmsg), which is typically a few dozen datagrams.  It
+ * takes the time quadratic in |n| in the worst case.  Processing the
+ * datagrams of a connection back to back keeps its state in cache,
+ * and the application can call `ngtcp2_conn_prefetch` for the
+ * connection of the next group before processing the current one.
+ *
+ * This function returns the number of groups.
  */
-#define NGTCP2_STREAM_CLOSE_FLAG_APP_ERROR_CODE_SET 0x01u
+NGTCP2_EXTERN size_t ngtcp2_pkt_group_by_dcid(ngtcp2_pkt_batch_entry *dest,
+                                              const ngtcp2_vec *dgrams,
+                                              size_t n, size_t short_dcidlen);
 
 /**
- * @functypedef
+ * @function
  *
- * :type:`ngtcp2_stream_close` is invoked when a stream is closed.
- * This callback is not called when QUIC connection is closed before
- * existing streams are closed.  |flags| is the bitwise-OR of zero or
- * more of :macro:`NGTCP2_STREAM_CLOSE_FLAG_*
- * <NGTCP2_STREAM_CLOSE_FLAG_NONE>`.  |app_error_code| indicates the
- * error code of this closure if
- * :macro:`NGTCP2_STREAM_CLOSE_FLAG_APP_ERROR_CODE_SET` is set in
- * |flags|.  If it is not set, the stream was closed without any error
- * code, which generally means success.
+ * `ngtcp2_pkt_decode_hd_long` decodes QUIC long packet header in
+ * |pkt| of length |pktlen|.  This function only parses the input just
+ * before packet number field.
  *
- * |app_error_code| is the first application error code sent by a
- * local endpoint, or received from a remote endpoint.  If a stream is
- * closed cleanly, no application error code is exchanged.  Since QUIC
- * stack does not know the application error code which indicates "no
- * errors", |app_error_code| is set to 0 and
- * :macro:`NGTCP2_STREAM_CLOSE_FLAG_APP_ERROR_CODE_SET` is not set in
- * |flags| in this case.
+ * This function does not verify that length field is correct.  In
+ * other words, this function succeeds even if length > |pktlen|.
  *
- * The implementation of this callback should return 0 if it succeeds.
- * Returning :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library
- * call return immediately.
+ * This function can handle Connection ID up to
+ * :macro:`NGTCP2_MAX_CIDLEN`.  Consider to use
+ * `ngtcp2_pkt_decode_version_cid` to get longer Connection ID.
+ *
+ * This function handles Version Negotiation specially.  If version
+ * field is 0, |pkt| must contain Version Negotiation packet.  Version
+ * Negotiation packet has random type in wire format.  For
+ * convenience, this function sets
+ * :enum:`ngtcp2_pkt_type.NGTCP2_PKT_VERSION_NEGOTIATION` to
+ * :member:`dest->type <ngtcp2_pkt_hd.type>`, clears
+ * :macro:`NGTCP2_PKT_FLAG_LONG_FORM` flag from :member:`dest->flags
+ * <ngtcp2_pkt_hd.flags>`, and sets 0 to :member:`dest->len
+ * <ngtcp2_pkt_hd.len>`.  Version Negotiation packet occupies a single
+ * packet.
+ *
+ * It stores the result in the object pointed by |dest|, and returns
+ * the number of bytes decoded to read the packet header if it
+ * succeeds, or one of the following error codes:
+ *
+ * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     Packet is too short; or it is not a long header
  */
-typedef int (*ngtcp2_stream_close)(ngtcp2_conn *conn, uint32_t flags,
-                                   int64_t stream_id, uint64_t app_error_code,
-                                   void *user_data, void *stream_user_data);
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_pkt_decode_hd_long(ngtcp2_pkt_hd *dest,
+                                                     const uint8_t *pkt,
+                                                     size_t pktlen);
 
 /**
- * @functypedef
+ * @function
  *
- * :type:`ngtcp2_stream_reset` is invoked when a stream identified by
- * |stream_id| is reset by a remote endpoint.
+ * `ngtcp2_pkt_decode_hd_short` decodes QUIC short header packet
+ * header in |pkt| of length |pktlen|.  |dcidlen| is the length of
+ * DCID in packet header.  Short header packet does not encode the
+ * length of connection ID, thus we need the input from the outside.
+ * This function only parses the input just before packet number
+ * field.  This function can handle Connection ID up to
+ * :macro:`NGTCP2_MAX_CIDLEN`.  Consider to use
+ * `ngtcp2_pkt_decode_version_cid` to get longer Connection ID.  It
+ * stores the result in the object pointed by |dest|, and returns the
+ * number of bytes decoded to read the packet header if it succeeds,
+ * or one of the following error codes:
  *
- * The implementation of this callback should return 0 if it succeeds.
- * Returning :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library
- * call return immediately.
+ * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     Packet is too short; or it is not a short header
  */
-typedef int (*ngtcp2_stream_reset)(ngtcp2_conn *conn, int64_t stream_id,
-                                   uint64_t final_size, uint64_t app_error_code,
-                                   void *user_data, void *stream_user_data);
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_pkt_decode_hd_short(ngtcp2_pkt_hd *dest,
+                                                      const uint8_t *pkt,
+                                                      size_t pktlen,
+                                                      size_t dcidlen);
 
 /**
- * @functypedef
+ * @function
  *
- * :type:`ngtcp2_acked_stream_data_offset` is a callback function
- * which is called when stream data is acked, and application can free
- * the data.  The acked range of data is [offset, offset + datalen).
- * For a given stream_id, this callback is called sequentially in
- * increasing order of |offset| without any overlap.  |datalen| is
- * normally strictly greater than 0.  One exception is that when a
- * packet which includes STREAM frame which has fin flag set, and 0
- * length data, this callback is invoked with 0 passed as |datalen|.
+ * `ngtcp2_pkt_write_stateless_reset` writes Stateless Reset packet in
+ * the buffer pointed by |dest| whose length is |destlen|.
+ * |stateless_reset_token| is a pointer to the Stateless Reset Token,
+ * and its length must be :macro:`NGTCP2_STATELESS_RESET_TOKENLEN`
+ * bytes long.  |rand| specifies the random octets preceding Stateless
+ * Reset Token.  The length of |rand| is specified by |randlen| which
+ * must be at least :macro:`NGTCP2_MIN_STATELESS_RESET_RANDLEN` bytes
+ * long.
  *
- * If a stream is closed prematurely and stream data is still
- * in-flight, this callback function is not called for those data.
+ * If |randlen| is too long to write them all in the buffer, |rand| is
+ * written to the buffer as much as possible, and is truncated.
  *
- * The implementation of this callback should return 0 if it succeeds.
- * Returning :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library
- * call return immediately.
+ * This function returns the number of bytes written to the buffer, or
+ * one of the following negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOBUF`
+ *     Buffer is too small.
+ * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     |randlen| is strictly less than
+ *     :macro:`NGTCP2_MIN_STATELESS_RESET_RANDLEN`.
  */
-typedef int (*ngtcp2_acked_stream_data_offset)(
-    ngtcp2_conn *conn, int64_t stream_id, uint64_t offset, uint64_t datalen,
-    void *user_data, void *stream_user_data);
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_pkt_write_stateless_reset(
+    uint8_t *dest, size_t destlen, const uint8_t *stateless_reset_token,
+    const uint8_t *rand, size_t randlen);
 
 /**
- * @functypedef
+ * @function
  *
- * :type:`ngtcp2_recv_stateless_reset` is a callback function which is
- * called when Stateless Reset packet is received.  The stateless
- * reset details are given in |sr|.
+ * `ngtcp2_pkt_write_version_negotiation` writes Version Negotiation
+ * packet in the buffer pointed by |dest| whose length is |destlen|.
+ * |unused_random| should be generated randomly.  |dcid| is the
+ * destination connection ID which appears in a packet as a source
+ * connection ID sent by client which caused version negotiation.
+ * Similarly, |scid| is the source connection ID which appears in a
+ * packet as a destination connection ID sent by client.  |sv| is a
+ * list of supported versions, and |nsv| specifies the number of
+ * supported versions included in |sv|.
  *
- * The implementation of this callback should return 0 if it succeeds.
- * Returning :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library
- * call return immediately.
+ * This function returns the number of bytes written to the buffer, or
+ * one of the following negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOBUF`
+ *     Buffer is too small.
  */
-typedef int (*ngtcp2_recv_stateless_reset)(ngtcp2_conn *conn,
-                                           const ngtcp2_pkt_stateless_reset *sr,
-                                           void *user_data);
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_pkt_write_version_negotiation(
+    uint8_t *dest, size_t destlen, uint8_t unused_random, const uint8_t *dcid,
+    size_t dcidlen, const uint8_t *scid, size_t scidlen, const uint32_t *sv,
+    size_t nsv);
 
 /**
- * @functypedef
- *
- * :type:`ngtcp2_extend_max_streams` is a callback function which is
- * called every time max stream ID is strictly extended.
- * |max_streams| is the cumulative number of streams which an endpoint
- * can open.
+ * @struct
  *
- * The callback function must return 0 if it succeeds.  Returning
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
- * immediately.
+ * :type:`ngtcp2_conn` represents a single QUIC connection.
  */
-typedef int (*ngtcp2_extend_max_streams)(ngtcp2_conn *conn,
-                                         uint64_t max_streams, void *user_data);
+typedef struct ngtcp2_conn ngtcp2_conn;
 
 /**
  * @functypedef
  *
- * :type:`ngtcp2_extend_max_stream_data` is a callback function which
- * is invoked when max stream data is extended.  |stream_id|
- * identifies the stream.  |max_data| is a cumulative number of bytes
- * the endpoint can send on this stream.
+ * :type:`ngtcp2_client_initial` is invoked when client application
+ * asks TLS stack to produce first TLS cryptographic handshake data.
  *
- * The callback function must return 0 if it succeeds.  Returning
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
- * immediately.
- */
-typedef int (*ngtcp2_extend_max_stream_data)(ngtcp2_conn *conn,
-                                             int64_t stream_id,
-                                             uint64_t max_data, void *user_data,
-                                             void *stream_user_data);
-
-/**
- * @functypedef
+ * This implementation of this callback must get the first handshake
+ * data from TLS stack and pass it to ngtcp2 library using
+ * `ngtcp2_conn_submit_crypto_data` function.  Make sure that before
+ * calling `ngtcp2_conn_submit_crypto_data` function, client
+ * application must create initial packet protection keys and IVs, and
+ * provide them to ngtcp2 library using
+ * `ngtcp2_conn_install_initial_key`.
  *
- * :type:`ngtcp2_rand` is a callback function to get randomized byte
- * string from application.  Application must fill random |destlen|
- * bytes to the buffer pointed by |dest|.  The generated bytes are
- * used only in non-cryptographic context.
+ * This callback function must return 0 if it succeeds, or
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library call
+ * return immediately.
  */
-typedef void (*ngtcp2_rand)(uint8_t *dest, size_t destlen,
-                            const ngtcp2_rand_ctx *rand_ctx);
+typedef int (*ngtcp2_client_initial)(ngtcp2_conn *conn, void *user_data);
 
 /**
  * @functypedef
  *
- * :type:`ngtcp2_get_new_connection_id` is a callback function to ask
- * an application for new connection ID.  Application must generate
- * new unused connection ID with the exact |cidlen| bytes and store it
- * in |cid|.  It also has to generate stateless reset token into
- * |token|.  The length of stateless reset token is
- * :macro:`NGTCP2_STATELESS_RESET_TOKENLEN` and it is guaranteed that
- * the buffer pointed by |cid| has the sufficient space to store the
- * token.
+ * :type:`ngtcp2_recv_client_initial` is invoked when server receives
+ * Initial packet from client.  An server application must implement
+ * this callback, and generate initial keys and IVs for both
+ * transmission and reception.  Install them using
+ * `ngtcp2_conn_install_initial_key`.  |dcid| is the destination
+ * connection ID which client generated randomly.  It is used to
+ * derive initial packet protection keys.
  *
- * The callback function must return 0 if it succeeds.  Returning
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
- * immediately.
+ * The callback function must return 0 if it succeeds.  If an error
+ * occurs, return :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the
+ * library call return immediately.
  */
-typedef int (*ngtcp2_get_new_connection_id)(ngtcp2_conn *conn, ngtcp2_cid *cid,
-                                            uint8_t *token, size_t cidlen,
-                                            void *user_data);
+typedef int (*ngtcp2_recv_client_initial)(ngtcp2_conn *conn,
+                                          const ngtcp2_cid *dcid,
+                                          void *user_data);
 
 /**
- * @functypedef
- *
- * :type:`ngtcp2_remove_connection_id` is a callback function which
- * notifies the application that connection ID |cid| is no longer used
- * by remote endpoint.
+ * @enum
  *
- * The callback function must return 0 if it succeeds.  Returning
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
- * immediately.
+ * :type:`ngtcp2_crypto_level` is encryption level.
  */
-typedef int (*ngtcp2_remove_connection_id)(ngtcp2_conn *conn,
-                                           const ngtcp2_cid *cid,
-                                           void *user_data);
+typedef enum ngtcp2_crypto_level {
+  /**
+   * :enum:`NGTCP2_CRYPTO_LEVEL_INITIAL` is Initial Keys encryption
+   * level.
+   */
+  NGTCP2_CRYPTO_LEVEL_INITIAL,
+  /**
+   * :enum:`NGTCP2_CRYPTO_LEVEL_HANDSHAKE` is Handshake Keys
+   * encryption level.
+   */
+  NGTCP2_CRYPTO_LEVEL_HANDSHAKE,
+  /**
+   * :enum:`NGTCP2_CRYPTO_LEVEL_APPLICATION` is Application Data
+   * (1-RTT) Keys encryption level.
+   */
+  NGTCP2_CRYPTO_LEVEL_APPLICATION,
+  /**
+   * :enum:`NGTCP2_CRYPTO_LEVEL_EARLY` is Early Data (0-RTT) Keys
+   * encryption level.
+   */
+  NGTCP2_CRYPTO_LEVEL_EARLY
+} ngtcp2_crypto_level;
 
 /**
  * @functypedef
  *
- * :type:`ngtcp2_update_key` is a callback function which tells the
- * application that it must generate new packet protection keying
- * materials and AEAD cipher context objects with new keys.  The
- * current set of secrets are given as |current_rx_secret| and
- * |current_tx_secret| of length |secretlen|.  They are decryption and
- * encryption secrets respectively.
+ * :type`ngtcp2_recv_crypto_data` is invoked when crypto data is
+ * received.  The received data is pointed to by |data|, and its
+ * length is |datalen|.  The |offset| specifies the offset where
+ * |data| is positioned.  |user_data| is the arbitrary pointer passed
+ * to `ngtcp2_conn_client_new` or `ngtcp2_conn_server_new`.  The
+ * ngtcp2 library ensures that the crypto data is passed to the
+ * application in the increasing order of |offset|.  |datalen| is
+ * always strictly greater than 0.  |crypto_level| indicates the
+ * encryption level where this data is received.  Crypto data can
+ * never be received in
+ * :enum:`ngtcp2_crypto_level.NGTCP2_CRYPTO_LEVEL_EARLY`.
  *
- * The application has to generate new secrets and keys for both
- * encryption and decryption, and write decryption secret and IV to
- * the buffer pointed by |rx_secret| and |rx_iv| respectively.  It
- * also has to create new AEAD cipher context object with new
- * decryption key and initialize |rx_aead_ctx| with it.  Similarly,
- * write encryption secret and IV to the buffer pointed by |tx_secret|
- * and |tx_iv|.  Create new AEAD cipher context object with new
- * encryption key and initialize |tx_aead_ctx| with it.  All given
- * buffers have the enough capacity to store secret, key and IV.
+ * The application should provide the given data to TLS stack.
  *
- * The callback function must return 0 if it succeeds.  Returning
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
- * immediately.
- */
-typedef int (*ngtcp2_update_key)(
-    ngtcp2_conn *conn, uint8_t *rx_secret, uint8_t *tx_secret,
-    ngtcp2_crypto_aead_ctx *rx_aead_ctx, uint8_t *rx_iv,
-    ngtcp2_crypto_aead_ctx *tx_aead_ctx, uint8_t *tx_iv,
-    const uint8_t *current_rx_secret, const uint8_t *current_tx_secret,
-    size_t secretlen, void *user_data);
-
-/**
- * @macrosection
+ * The callback function must return 0 if it succeeds, or one of the
+ * following negative error codes:
  *
- * Path validation related macros
- */
-
-/**
- * @macro
+ * - :macro:`NGTCP2_ERR_CRYPTO`
+ * - :macro:`NGTCP2_ERR_REQUIRED_TRANSPORT_PARAM`
+ * - :macro:`NGTCP2_ERR_MALFORMED_TRANSPORT_PARAM`
+ * - :macro:`NGTCP2_ERR_TRANSPORT_PARAM`
+ * - :macro:`NGTCP2_ERR_PROTO`
+ * - :macro:`NGTCP2_ERR_VERSION_NEGOTIATION_FAILURE`
+ * - :macro:`NGTCP2_ERR_NOMEM`
+ * - :macro:`NGTCP2_ERR_CALLBACK_FAILURE`
  *
- * :macro:`NGTCP2_PATH_VALIDATION_FLAG_NONE` indicates no flag set.
- */
-#define NGTCP2_PATH_VALIDATION_FLAG_NONE 0x00u
-
-/**
- * @macro
+ * If the other value is returned, it is treated as
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`.
  *
- * :macro:`NGTCP2_PATH_VALIDATION_FLAG_PREFERRED_ADDR` indicates the
- * validation involving server preferred address.  This flag is only
- * set for client.
+ * If application encounters fatal error, return
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library call
+ * return immediately.
  */
-#define NGTCP2_PATH_VALIDATION_FLAG_PREFERRED_ADDR 0x01u
+typedef int (*ngtcp2_recv_crypto_data)(ngtcp2_conn *conn,
+                                       ngtcp2_crypto_level crypto_level,
+                                       uint64_t offset, const uint8_t *data,
+                                       size_t datalen, void *user_data);
 
 /**
  * @functypedef
  *
- * :type:`ngtcp2_path_validation` is a callback function which tells
- * the application the outcome of path validation.  |flags| is zero or
- * more of :macro:`NGTCP2_PATH_VALIDATION_FLAG_*
- * <NGTCP2_PATH_VALIDATION_FLAG_NONE>`.  |path| is the path that was
- * validated.  If |res| is
- * :enum:`ngtcp2_path_validation_result.NGTCP2_PATH_VALIDATION_RESULT_SUCCESS`,
- * the path validation succeeded.  If |res| is
- * :enum:`ngtcp2_path_validation_result.NGTCP2_PATH_VALIDATION_RESULT_FAILURE`,
- * the path validation failed.
+ * :type:`ngtcp2_handshake_completed` is invoked when QUIC
+ * cryptographic handshake has completed.
  *
  * The callback function must return 0 if it succeeds.  Returning
  * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
  * immediately.
  */
-typedef int (*ngtcp2_path_validation)(ngtcp2_conn *conn, uint32_t flags,
-                                      const ngtcp2_path *path,
-                                      ngtcp2_path_validation_result res,
-                                      void *user_data);
+typedef int (*ngtcp2_handshake_completed)(ngtcp2_conn *conn, void *user_data);
 
 /**
  * @functypedef
  *
- * :type:`ngtcp2_select_preferred_addr` is a callback function which
- * asks a client application to choose server address from preferred
- * addresses |paddr| received from server.  An application should
- * write a network path for a selected preferred address in |dest|.
- * More specifically, the selected preferred address must be set to
- * :member:`dest->remote <ngtcp2_path.remote>`, a client source
- * address must be set to :member:`dest->local <ngtcp2_path.local>`.
- * If a client source address does not change for the new server
- * address, leave :member:`dest->local <ngtcp2_path.local>`
- * unmodified, or copy the value of :member:`local
- * <ngtcp2_path.local>` field of the current network path obtained
- * from `ngtcp2_conn_get_path()`.  Both :member:`dest->local.addr
- * <ngtcp2_addr.addr>` and :member:`dest->remote.addr
- * <ngtcp2_addr.addr>` point to buffers which are at least
- * ``sizeof(struct sockaddr_storage)`` bytes long, respectively.  If
- * an application denies the preferred addresses, just leave |dest|
- * unmodified (or set :member:`dest->remote.addrlen
- * <ngtcp2_addr.addrlen>` to 0) and return 0.
+ * :type:`ngtcp2_handshake_confirmed` is invoked when QUIC
+ * cryptographic handshake is confirmed.  The handshake confirmation
+ * means that both endpoints agree that handshake has finished.
  *
  * The callback function must return 0 if it succeeds.  Returning
  * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
  * immediately.
  */
-typedef int (*ngtcp2_select_preferred_addr)(ngtcp2_conn *conn,
-                                            ngtcp2_path *dest,
-                                            const ngtcp2_preferred_addr *paddr,
-                                            void *user_data);
+typedef int (*ngtcp2_handshake_confirmed)(ngtcp2_conn *conn, void *user_data);
 
 /**
- * @enum
+ * @functypedef
  *
- * :type:`ngtcp2_connection_id_status_type` defines a set of status
- * for Destination Connection ID.
+ * :type:`ngtcp2_recv_version_negotiation` is invoked when Version
+ * Negotiation packet is received.  |hd| is the pointer to the QUIC
+ * packet header object.  The vector |sv| of |nsv| elements contains
+ * the QUIC version the server supports.  Since Version Negotiation is
+ * only sent by server, this callback function is used by client only.
+ *
+ * The callback function must return 0 if it succeeds, or
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library call
+ * return immediately.
  */
-typedef enum ngtcp2_connection_id_status_type {
-  /**
-   * :enum:`NGTCP2_CONNECTION_ID_STATUS_TYPE_ACTIVATE` indicates that
-   * a local endpoint starts using new destination Connection ID.
-   */
-  NGTCP2_CONNECTION_ID_STATUS_TYPE_ACTIVATE,
-  /**
-   * :enum:`NGTCP2_CONNECTION_ID_STATUS_TYPE_DEACTIVATE` indicates
-   * that a local endpoint stops using a given destination Connection
-   * ID.
-   */
-  NGTCP2_CONNECTION_ID_STATUS_TYPE_DEACTIVATE
-} ngtcp2_connection_id_status_type;
+typedef int (*ngtcp2_recv_version_negotiation)(ngtcp2_conn *conn,
+                                               const ngtcp2_pkt_hd *hd,
+                                               const uint32_t *sv, size_t nsv,
+                                               void *user_data);
 
 /**
  * @functypedef
  *
- * :type:`ngtcp2_connection_id_status` is a callback function which is
- * called when the status of Connection ID changes.
+ * :type:`ngtcp2_recv_retry` is invoked when Retry packet is received.
+ * This callback is client use only.
  *
- * |token| is the associated stateless reset token and it is ``NULL``
- * if no token is present.
+ * Application must regenerate packet protection key, IV, and header
+ * protection key for Initial packets using the destination connection
+ * ID obtained by :member:`hd->scid <ngtcp2_pkt_hd.scid>` and install
+ * them by calling `ngtcp2_conn_install_initial_key()`.
  *
- * |type| is the one of the value defined in
- * :type:`ngtcp2_connection_id_status_type`.  The new value might be
- * added in the future release.
+ * 0-RTT data accepted by the ngtcp2 library will be automatically
+ * retransmitted as 0-RTT data by the library.
  *
  * The callback function must return 0 if it succeeds.  Returning
  * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
  * immediately.
  */
-typedef int (*ngtcp2_connection_id_status)(ngtcp2_conn *conn, int type,
-                                           uint64_t seq, const ngtcp2_cid *cid,
-                                           const uint8_t *token,
-                                           void *user_data);
+typedef int (*ngtcp2_recv_retry)(ngtcp2_conn *conn, const ngtcp2_pkt_hd *hd,
+                                 void *user_data);
 
 /**
  * @functypedef
  *
- * :type:`ngtcp2_recv_new_token` is a callback function which is
- * called when new token is received from server.
+ * :type:`ngtcp2_encrypt` is invoked when the ngtcp2 library asks the
+ * application to encrypt packet payload.  The packet payload to
+ * encrypt is passed as |plaintext| of length |plaintextlen|.  The
+ * AEAD cipher is |aead|.  |aead_ctx| is the AEAD cipher context
+ * object which is initialized with encryption key.  The nonce is
+ * passed as |nonce| of length |noncelen|.  The Additional
+ * Authenticated Data is passed as |aad| of length |aadlen|.
  *
- * |token| is the received token.
+ * The implementation of this callback must encrypt |plaintext| using
+ * the negotiated cipher suite and write the ciphertext into the
+ * buffer pointed by |dest|.  |dest| has enough capacity to store the
+ * ciphertext and any additional AEAD tag data.
  *
- * The callback function must return 0 if it succeeds.  Returning
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
- * immediately.
- */
-typedef int (*ngtcp2_recv_new_token)(ngtcp2_conn *conn, const ngtcp2_vec *token,
-                                     void *user_data);
-
-/**
- * @functypedef
+ * |dest| and |plaintext| may point to the same buffer.
  *
- * :type:`ngtcp2_delete_crypto_aead_ctx` is a callback function which
- * must delete the native object pointed by
- * :member:`aead_ctx->native_handle
- * <ngtcp2_crypto_aead_ctx.native_handle>`.
+ * The callback function must return 0 if it succeeds, or
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library call
+ * return immediately.
  */
-typedef void (*ngtcp2_delete_crypto_aead_ctx)(ngtcp2_conn *conn,
-                                              ngtcp2_crypto_aead_ctx *aead_ctx,
-                                              void *user_data);
+typedef int (*ngtcp2_encrypt)(uint8_t *dest, const ngtcp2_crypto_aead *aead,
+                              const ngtcp2_crypto_aead_ctx *aead_ctx,
+                              const uint8_t *plaintext, size_t plaintextlen,
+                              const uint8_t *nonce, size_t noncelen,
+                              const uint8_t *aad, size_t aadlen);
 
 /**
  * @functypedef
  *
- * :type:`ngtcp2_delete_crypto_cipher_ctx` is a callback function
- * which must delete the native object pointed by
- * :member:`cipher_ctx->native_handle
- * <ngtcp2_crypto_cipher_ctx.native_handle>`.
- */
-typedef void (*ngtcp2_delete_crypto_cipher_ctx)(
-    ngtcp2_conn *conn, ngtcp2_crypto_cipher_ctx *cipher_ctx, void *user_data);
-
-/**
- * @macrosection
+ * :type:`ngtcp2_encrypt_vec` is invoked when the ngtcp2 library asks
+ * the application to encrypt packet payload which is scattered over
+ * multiple buffers.  The packet payload to encrypt is the
+ * concatenation of |plaintextcnt| vectors pointed by |plaintext|.
+ * The other arguments have the same meaning as in
+ * :type:`ngtcp2_encrypt`.
  *
- * Datagram flags
- */
-
-/**
- * @macro
+ * The implementation of this callback must encrypt the payload using
+ * the negotiated cipher suite and write the ciphertext into the
+ * contiguous buffer pointed by |dest|, followed by AEAD tag.
  *
- * :macro:`NGTCP2_DATAGRAM_FLAG_NONE` indicates no flag set.
+ * Each vector either does not overlap with |dest|, or is located in
+ * |dest| at exactly the offset where its ciphertext is written.  The
+ * former refers to application data, for example, STREAM data that
+ * the library does not copy into the packet buffer.  The data pointed
+ * by such vector must not be altered.
+ *
+ * The callback function must return 0 if it succeeds, or
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library call
+ * return immediately.
  */
-#define NGTCP2_DATAGRAM_FLAG_NONE 0x00u
+typedef int (*ngtcp2_encrypt_vec)(uint8_t *dest,
+                                  const ngtcp2_crypto_aead *aead,
+                                  const ngtcp2_crypto_aead_ctx *aead_ctx,
+                                  const ngtcp2_vec *plaintext,
+                                  size_t plaintextcnt, const uint8_t *nonce,
+                                  size_t noncelen, const uint8_t *aad,
+                                  size_t aadlen);
 
 /**
- * @macro
+ * @struct
  *
- * :macro:`NGTCP2_DATAGRAM_FLAG_EARLY` indicates that DATAGRAM frame
- * is received in 0RTT packet and the handshake has not completed yet,
- * which means that the data might be replayed.
+ * :type:`ngtcp2_encrypt_op` describes a single AEAD encryption which
+ * is a part of :type:`ngtcp2_encrypt_batch` call.  The fields have
+ * the same meaning as the parameters of :type:`ngtcp2_encrypt`.
  */
-#define NGTCP2_DATAGRAM_FLAG_EARLY 0x01u
+typedef struct ngtcp2_encrypt_op {
+  /**
+   * :member:`dest` is the buffer to write ciphertext and AEAD tag.
+   */
+  uint8_t *dest;
+  /**
+   * :member:`plaintext` is the packet payload to encrypt.  It may
+   * point to the same buffer as :member:`dest`.
+   */
+  const uint8_t *plaintext;
+  /**
+   * :member:`plaintextlen` is the length of :member:`plaintext`.
+   */
+  size_t plaintextlen;
+  /**
+   * :member:`nonce` is the nonce.
+   */
+  const uint8_t *nonce;
+  /**
+   * :member:`noncelen` is the length of :member:`nonce`.
+   */
+  size_t noncelen;
+  /**
+   * :member:`aad` is the Additional Authenticated Data.
+   */
+  const uint8_t *aad;
+  /**
+   * :member:`aadlen` is the length of :member:`aad`.
+   */
+  size_t aadlen;
+} ngtcp2_encrypt_op;
 
 /**
  * @functypedef
  *
- * :type:`ngtcp2_recv_datagram` is invoked when DATAGRAM frame is
- * received.  |flags| is bitwise-OR of zero or more of
- * :macro:`NGTCP2_DATAGRAM_FLAG_* <NGTCP2_DATAGRAM_FLAG_NONE>`.
+ * :type:`ngtcp2_encrypt_batch` is invoked when the ngtcp2 library
+ * asks the application to encrypt the payload of multiple 1RTT
+ * packets at once.  All packets are encrypted with the same AEAD
+ * cipher |aead| and the same AEAD cipher context |aead_ctx|.  The
+ * encryptions to perform are given as |ops| of length |opslen|.
  *
- * If :macro:`NGTCP2_DATAGRAM_FLAG_EARLY` is set in |flags|, it
- * indicates that DATAGRAM frame was received in 0RTT packet and a
- * handshake has not completed yet.
+ * The implementation of this callback must perform all encryptions
+ * in |ops| as if :type:`ngtcp2_encrypt` is called for each of them.
+ * The order in which they are performed is not significant.  This
+ * allows the implementation to use the multi-buffer cipher
+ * implementation if it is available.
  *
  * The callback function must return 0 if it succeeds, or
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library return
- * immediately.
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library call
+ * return immediately.
  */
-typedef int (*ngtcp2_recv_datagram)(ngtcp2_conn *conn, uint32_t flags,
-                                    const uint8_t *data, size_t datalen,
-                                    void *user_data);
+typedef int (*ngtcp2_encrypt_batch)(const ngtcp2_crypto_aead *aead,
+                                    const ngtcp2_crypto_aead_ctx *aead_ctx,
+                                    const ngtcp2_encrypt_op *ops,
+                                    size_t opslen);
 
 /**
  * @functypedef
  *
- * :type:`ngtcp2_ack_datagram` is invoked when a packet which contains
- * DATAGRAM frame which is identified by |dgram_id| is acknowledged.
- * |dgram_id| is the valued passed to `ngtcp2_conn_writev_datagram`.
+ * :type:`ngtcp2_decrypt` is invoked when the ngtcp2 library asks the
+ * application to decrypt packet payload.  The packet payload to
+ * decrypt is passed as |ciphertext| of length |ciphertextlen|.  The
+ * AEAD cipher is |aead|.  |aead_ctx| is the AEAD cipher context
+ * object which is initialized with decryption key.  The nonce is
+ * passed as |nonce| of length |noncelen|.  The Additional
+ * Authenticated Data is passed as |aad| of length |aadlen|.
  *
- * The callback function must return 0 if it succeeds, or
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library return
- * immediately.
+ * The implementation of this callback must decrypt |ciphertext| using
+ * the negotiated cipher suite and write the ciphertext into the
+ * buffer pointed by |dest|.  |dest| has enough capacity to store the
+ * cleartext.
+ *
+ * |dest| and |ciphertext| may point to the same buffer.
+ *
+ * The callback function must return 0 if it succeeds.  If TLS stack
+ * fails to decrypt data, return :macro:`NGTCP2_ERR_DECRYPT`.  For any
+ * other errors, return :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which
+ * makes the library call return immediately.
  */
-typedef int (*ngtcp2_ack_datagram)(ngtcp2_conn *conn, uint64_t dgram_id,
-                                   void *user_data);
+typedef int (*ngtcp2_decrypt)(uint8_t *dest, const ngtcp2_crypto_aead *aead,
+                              const ngtcp2_crypto_aead_ctx *aead_ctx,
+                              const uint8_t *ciphertext, size_t ciphertextlen,
+                              const uint8_t *nonce, size_t noncelen,
+                              const uint8_t *aad, size_t aadlen);
 
 /**
  * @functypedef
  *
- * :type:`ngtcp2_lost_datagram` is invoked when a packet which
- * contains DATAGRAM frame which is identified by |dgram_id| is
- * declared lost.  |dgram_id| is the valued passed to
- * `ngtcp2_conn_writev_datagram`.  Note that the loss might be
- * spurious, and DATAGRAM frame might be acknowledged later.
+ * :type:`ngtcp2_hp_mask` is invoked when the ngtcp2 library asks the
+ * application to produce a mask to encrypt or decrypt packet header.
+ * The encryption cipher is |hp|.  |hp_ctx| is the cipher context
+ * object which is initialized with header protection key.  The sample
+ * is passed as |sample| which is :macro:`NGTCP2_HP_SAMPLELEN` bytes
+ * long.
+ *
+ * The implementation of this callback must produce a mask using the
+ * header protection cipher suite specified by QUIC specification and
+ * write the result into the buffer pointed by |dest|.  The length of
+ * the mask must be at least :macro:`NGTCP2_HP_MASKLEN`.  The library
+ * only uses the first :macro:`NGTCP2_HP_MASKLEN` bytes of the
+ * produced mask.  The buffer pointed by |dest| is guaranteed to have
+ * at least :macro:`NGTCP2_HP_SAMPLELEN` bytes available for
+ * convenience.
  *
  * The callback function must return 0 if it succeeds, or
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library return
- * immediately.
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library call
+ * return immediately.
  */
-typedef int (*ngtcp2_lost_datagram)(ngtcp2_conn *conn, uint64_t dgram_id,
-                                    void *user_data);
+typedef int (*ngtcp2_hp_mask)(uint8_t *dest, const ngtcp2_crypto_cipher *hp,
+                              const ngtcp2_crypto_cipher_ctx *hp_ctx,
+                              const uint8_t *sample);
 
 /**
  * @functypedef
  *
- * :type:`ngtcp2_get_path_challenge_data` is a callback function to
- * ask an application for new data that is sent in PATH_CHALLENGE
- * frame.  Application must generate new unpredictable exactly
- * :macro:`NGTCP2_PATH_CHALLENGE_DATALEN` bytes of random data and
- * store them into the buffer pointed by |data|.
+ * :type:`ngtcp2_encrypt_hp_mask` is invoked when the ngtcp2 library
+ * asks the application to encrypt packet payload and to produce a
+ * header protection mask for the resulting packet in a single call.
+ * It combines :type:`ngtcp2_encrypt` and :type:`ngtcp2_hp_mask` so
+ * that an AEAD implementation which can compute the header protection
+ * mask while it encrypts the payload (e.g., picotls fusion) avoids a
+ * second pass over the ciphertext.
+ *
+ * The arguments |dest|, |aead|, |aead_ctx|, |plaintext|,
+ * |plaintextlen|, |nonce|, |noncelen|, |aad|, and |aadlen| have the
+ * same meaning as in :type:`ngtcp2_encrypt`.  The mask must be
+ * produced with the header protection cipher |hp| and |hp_ctx| from
+ * the :macro:`NGTCP2_HP_SAMPLELEN` bytes sample which starts at
+ * |dest| + |sample_offset|, that is, from the ciphertext written by
+ * this callback.  The mask must be written into the buffer pointed by
+ * |mask| which has at least :macro:`NGTCP2_HP_SAMPLELEN` bytes
+ * available.  The library only uses the first
+ * :macro:`NGTCP2_HP_MASKLEN` bytes of the produced mask.
  *
- * The callback function must return 0 if it succeeds.  Returning
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
- * immediately.
+ * The callback function must return 0 if it succeeds, or
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library call
+ * return immediately.
  */
-typedef int (*ngtcp2_get_path_challenge_data)(ngtcp2_conn *conn, uint8_t *data,
-                                              void *user_data);
+typedef int (*ngtcp2_encrypt_hp_mask)(
+    uint8_t *dest, uint8_t *mask, const ngtcp2_crypto_aead *aead,
+    const ngtcp2_crypto_aead_ctx *aead_ctx, const uint8_t *plaintext,
+    size_t plaintextlen, const uint8_t *nonce, size_t noncelen,
+    const uint8_t *aad, size_t aadlen, const ngtcp2_crypto_cipher *hp,
+    const ngtcp2_crypto_cipher_ctx *hp_ctx, size_t sample_offset);
 
 /**
  * @functypedef
  *
- * :type:`ngtcp2_stream_stop_sending` is invoked when a stream is no
- * longer read by a local endpoint before it receives all stream data.
- * This function is called at most once per stream.  |app_error_code|
- * is the error code passed to `ngtcp2_conn_shutdown_stream_read` or
- * `ngtcp2_conn_shutdown_stream`.
+ * :type:`ngtcp2_hp_mask_batch` is invoked when the ngtcp2 library
+ * asks the application to produce masks for multiple packets at
+ * once.  All masks are produced with the same header protection
+ * cipher |hp| and the same cipher context |hp_ctx|.  The samples are
+ * passed as |samples| of length |nsamples|, and each sample is
+ * :macro:`NGTCP2_HP_SAMPLELEN` bytes long.
+ *
+ * The implementation of this callback must produce the mask for
+ * |samples| [i] as :type:`ngtcp2_hp_mask` does, and write it into the
+ * buffer pointed by |dest| + i * :macro:`NGTCP2_HP_SAMPLELEN`.  The
+ * buffer pointed by |dest| is guaranteed to have at least |nsamples|
+ * * :macro:`NGTCP2_HP_SAMPLELEN` bytes available.  This allows the
+ * implementation to encrypt all samples in one pass, for example,
+ * with AES-ECB over many blocks.
  *
- * The callback function must return 0 if it succeeds.  Returning
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
- * immediately.
+ * The callback function must return 0 if it succeeds, or
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library call
+ * return immediately.
  */
-typedef int (*ngtcp2_stream_stop_sending)(ngtcp2_conn *conn, int64_t stream_id,
-                                          uint64_t app_error_code,
-                                          void *user_data,
-                                          void *stream_user_data);
+typedef int (*ngtcp2_hp_mask_batch)(uint8_t *dest,
+                                    const ngtcp2_crypto_cipher *hp,
+                                    const ngtcp2_crypto_cipher_ctx *hp_ctx,
+                                    const uint8_t *const *samples,
+                                    size_t nsamples);
+
+/**
+ * @macrosection
+ *
+ * Stream data flags
+ */
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_STREAM_DATA_FLAG_NONE` indicates no flag set.
+ */
+#define NGTCP2_STREAM_DATA_FLAG_NONE 0x00u
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_STREAM_DATA_FLAG_FIN` indicates that this chunk of
+ * data is final piece of an incoming stream.
+ */
+#define NGTCP2_STREAM_DATA_FLAG_FIN 0x01u
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_STREAM_DATA_FLAG_EARLY` indicates that this chunk of
+ * data contains data received in 0RTT packet and the handshake has
+ * not completed yet, which means that the data might be replayed.
+ */
+#define NGTCP2_STREAM_DATA_FLAG_EARLY 0x02u
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_STREAM_DATA_FLAG_LOANED` indicates that this chunk
+ * of data is loaned from the reorder buffer of the stream.  It stays
+ * valid after the callback returns until the application releases it
+ * by `ngtcp2_conn_release_stream_data`, or the stream is closed.
+ * This flag is only set if
+ * :member:`ngtcp2_settings.loan_stream_data` is nonzero.
+ */
+#define NGTCP2_STREAM_DATA_FLAG_LOANED 0x04u
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_STREAM_DATA_FLAG_IN_PLACE` indicates that this chunk
+ * of data points into the buffer which the application passed to
+ * `ngtcp2_conn_read_pkt`.  It stays valid after the callback returns
+ * as long as the application keeps that buffer.  This flag is only
+ * set if :member:`ngtcp2_settings.decrypt_in_place` is nonzero, and
+ * never set for the data which was buffered by the library.
+ */
+#define NGTCP2_STREAM_DATA_FLAG_IN_PLACE 0x08u
 
 /**
  * @functypedef
  *
- * :type:`ngtcp2_version_negotiation` is invoked when the compatible
- * version negotiation takes place.  For client, it is called when it
- * sees a change in version field of a long header packet.  This
- * callback function might be called multiple times for client.  For
- * server, it is called once when the version is negotiated.
+ * :type:`ngtcp2_recv_stream_data` is invoked when stream data is
+ * received.  The stream is specified by |stream_id|.  |flags| is the
+ * bitwise-OR of zero or more of :macro:`NGTCP2_STREAM_DATA_FLAG_*
+ * <NGTCP2_STREAM_DATA_FLAG_NONE>`.  If |flags| &
+ * :macro:`NGTCP2_STREAM_DATA_FLAG_FIN` is nonzero, this portion of
+ * the data is the last data in this stream.  |offset| is the offset
+ * where this data begins.  The library ensures that data is passed to
+ * the application in the non-decreasing order of |offset| without any
+ * overlap.  The data is passed as |data| of length |datalen|.
+ * |datalen| may be 0 if and only if |fin| is nonzero.
  *
- * The implementation of this callback must install new Initial keys
- * for |version|.  Use `ngtcp2_conn_install_vneg_initial_key` to
- * install keys.
+ * If :macro:`NGTCP2_STREAM_DATA_FLAG_EARLY` is set in |flags|, it
+ * indicates that a part of or whole data was received in 0RTT packet
+ * and a handshake has not completed yet.
  *
- * The callback function must return 0 if it succeeds.  Returning
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
+ * If :macro:`NGTCP2_STREAM_DATA_FLAG_LOANED` is set in |flags|, |data|
+ * is valid until it is released by `ngtcp2_conn_release_stream_data`.
+ * If :macro:`NGTCP2_STREAM_DATA_FLAG_IN_PLACE` is set in |flags|,
+ * |data| is valid while the application keeps the buffer passed to
+ * `ngtcp2_conn_read_pkt`.  Otherwise, |data| is only valid during the
+ * callback.
+ *
+ * The callback function must return 0 if it succeeds, or
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library return
  * immediately.
  */
-typedef int (*ngtcp2_version_negotiation)(ngtcp2_conn *conn, uint32_t version,
-                                          const ngtcp2_cid *client_dcid,
-                                          void *user_data);
+typedef int (*ngtcp2_recv_stream_data)(ngtcp2_conn *conn, uint32_t flags,
+                                       int64_t stream_id, uint64_t offset,
+                                       const uint8_t *data, size_t datalen,
+                                       void *user_data, void *stream_user_data);
 
 /**
  * @functypedef
  *
- * :type:`ngtcp2_recv_key` is invoked when new key is installed to
- * |conn| during QUIC cryptographic handshake.
+ * :type:`ngtcp2_stream_open` is a callback function which is called
+ * when remote stream is opened by peer.  This function is not called
+ * if stream is opened by implicitly (we might reconsider this
+ * behaviour).
  *
- * The callback function must return 0 if it succeeds.  Returning
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
- * immediately.
+ * The implementation of this callback should return 0 if it succeeds.
+ * Returning :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library
+ * call return immediately.
  */
-typedef int (*ngtcp2_recv_key)(ngtcp2_conn *conn, ngtcp2_crypto_level level,
-                               void *user_data);
+typedef int (*ngtcp2_stream_open)(ngtcp2_conn *conn, int64_t stream_id,
+                                  void *user_data);
 
-#define NGTCP2_CALLBACKS_VERSION_V1 1
-#define NGTCP2_CALLBACKS_VERSION NGTCP2_CALLBACKS_VERSION_V1
+/**
+ * @macrosection
+ *
+ * Stream close flags
+ */
 
 /**
- * @struct
+ * @macro
  *
- * :type:`ngtcp2_callbacks` holds a set of callback functions.
+ * :macro:`NGTCP2_STREAM_CLOSE_FLAG_NONE` indicates no flag set.
  */
-typedef struct ngtcp2_callbacks {
-  /**
-   * :member:`client_initial` is a callback function which is invoked
-   * when client asks TLS stack to produce first TLS cryptographic
-   * handshake message.  This callback function must be specified for
-   * a client application.
-   */
-  ngtcp2_client_initial client_initial;
-  /**
-   * :member:`recv_client_initial` is a callback function which is
-   * invoked when a server receives the first packet from client.
-   * This callback function must be specified for a server application.
-   */
-  ngtcp2_recv_client_initial recv_client_initial;
-  /**
-   * :member:`recv_crypto_data` is a callback function which is
-   * invoked when cryptographic data (CRYPTO frame, in other words,
-   * TLS message) is received.  This callback function must be
-   * specified.
-   */
-  ngtcp2_recv_crypto_data recv_crypto_data;
-  /**
-   * :member:`handshake_completed` is a callback function which is
-   * invoked when QUIC cryptographic handshake has completed.  This
-   * callback function is optional.
-   */
-  ngtcp2_handshake_completed handshake_completed;
-  /**
-   * :member:`recv_version_negotiation` is a callback function which
-   * is invoked when Version Negotiation packet is received by a
-   * client.  This callback function is optional.
-   */
-  ngtcp2_recv_version_negotiation recv_version_negotiation;
-  /**
-   * :member:`encrypt` is a callback function which is invoked to
-   * encrypt a QUIC packet.  This callback function must be specified.
-   */
-  ngtcp2_encrypt encrypt;
-  /**
-   * :member:`decrypt` is a callback function which is invoked to
-   * decrypt a QUIC packet.  This callback function must be specified.
-   */
-  ngtcp2_decrypt decrypt;
-  /**
-   * :member:`hp_mask` is a callback function which is invoked to get
-   * a mask to encrypt or decrypt packet header.  This callback
-   * function must be specified.
-   */
-  ngtcp2_hp_mask hp_mask;
-  /**
-   * :member:`recv_stream_data` is a callback function which is
-   * invoked when STREAM data, which includes application data, is
-   * received.  This callback function is optional.
-   */
-  ngtcp2_recv_stream_data recv_stream_data;
-  /**
-   * :member:`acked_stream_data_offset` is a callback function which
-   * is invoked when STREAM data, which includes application data, is
-   * acknowledged by a remote endpoint.  It tells an application the
-   * largest offset of acknowledged STREAM data without a gap so that
-   * application can free memory for the data.  This callback function
-   * is optional.
-   */
-  ngtcp2_acked_stream_data_offset acked_stream_data_offset;
-  /**
-   * :member:`stream_open` is a callback function which is invoked
-   * when new remote stream is opened by a remote endpoint.  This
-   * callback function is optional.
+#define NGTCP2_STREAM_CLOSE_FLAG_NONE 0x00u
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_STREAM_CLOSE_FLAG_APP_ERROR_CODE_SET` indicates that
+ * app_error_code parameter is set.
+ */
+#define NGTCP2_STREAM_CLOSE_FLAG_APP_ERROR_CODE_SET 0x01u
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_stream_close` is invoked when a stream is closed.
+ * This callback is not called when QUIC connection is closed before
+ * existing streams are closed.  |flags| is the bitwise-OR of zero or
+ * more of :macro:`NGTCP2_STREAM_CLOSE_FLAG_*
+ * <NGTCP2_STREAM_CLOSE_FLAG_NONE>`.  |app_error_code| indicates the
+ * error code of this closure if
+ * :macro:`NGTCP2_STREAM_CLOSE_FLAG_APP_ERROR_CODE_SET` is set in
+ * |flags|.  If it is not set, the stream was closed without any error
+ * code, which generally means success.
+ *
+ * |app_error_code| is the first application error code sent by a
+ * local endpoint, or received from a remote endpoint.  If a stream is
+ * closed cleanly, no application error code is exchanged.  Since QUIC
+ * stack does not know the application error code which indicates "no
+ * errors", |app_error_code| is set to 0 and
+ * :macro:`NGTCP2_STREAM_CLOSE_FLAG_APP_ERROR_CODE_SET` is not set in
+ * |flags| in this case.
+ *
+ * The implementation of this callback should return 0 if it succeeds.
+ * Returning :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library
+ * call return immediately.
+ */
+typedef int (*ngtcp2_stream_close)(ngtcp2_conn *conn, uint32_t flags,
+                                   int64_t stream_id, uint64_t app_error_code,
+                                   void *user_data, void *stream_user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_stream_reset` is invoked when a stream identified by
+ * |stream_id| is reset by a remote endpoint.
+ *
+ * The implementation of this callback should return 0 if it succeeds.
+ * Returning :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library
+ * call return immediately.
+ */
+typedef int (*ngtcp2_stream_reset)(ngtcp2_conn *conn, int64_t stream_id,
+                                   uint64_t final_size, uint64_t app_error_code,
+                                   void *user_data, void *stream_user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_acked_stream_data_offset` is a callback function
+ * which is called when stream data is acked, and application can free
+ * the data.  The acked range of data is [offset, offset + datalen).
+ * For a given stream_id, this callback is called sequentially in
+ * increasing order of |offset| without any overlap.  |datalen| is
+ * normally strictly greater than 0.  One exception is that when a
+ * packet which includes STREAM frame which has fin flag set, and 0
+ * length data, this callback is invoked with 0 passed as |datalen|.
+ *
+ * If a stream is closed prematurely and stream data is still
+ * in-flight, this callback function is not called for those data.
+ *
+ * The implementation of this callback should return 0 if it succeeds.
+ * Returning :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library
+ * call return immediately.
+ */
+typedef int (*ngtcp2_acked_stream_data_offset)(
+    ngtcp2_conn *conn, int64_t stream_id, uint64_t offset, uint64_t datalen,
+    void *user_data, void *stream_user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_release_stream_buf` is a callback function which is
+ * invoked when the library no longer refers to the application buffer
+ * attached by `ngtcp2_conn_attach_stream_buf`.  |buf_user_data| is the
+ * opaque pointer passed to `ngtcp2_conn_attach_stream_buf`.  It is
+ * called when all stream data in the buffer are acknowledged by a
+ * remote endpoint, or the stream is closed or discarded, whichever
+ * comes first.  It is also called for the remaining buffers when
+ * |conn| is deleted.
+ */
+typedef void (*ngtcp2_release_stream_buf)(ngtcp2_conn *conn, int64_t stream_id,
+                                          void *buf_user_data, void *user_data,
+                                          void *stream_user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_recv_stateless_reset` is a callback function which is
+ * called when Stateless Reset packet is received.  The stateless
+ * reset details are given in |sr|.
+ *
+ * The implementation of this callback should return 0 if it succeeds.
+ * Returning :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library
+ * call return immediately.
+ */
+typedef int (*ngtcp2_recv_stateless_reset)(ngtcp2_conn *conn,
+                                           const ngtcp2_pkt_stateless_reset *sr,
+                                           void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_extend_max_streams` is a callback function which is
+ * called every time max stream ID is strictly extended.
+ * |max_streams| is the cumulative number of streams which an endpoint
+ * can open.
+ *
+ * The callback function must return 0 if it succeeds.  Returning
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
+ * immediately.
+ */
+typedef int (*ngtcp2_extend_max_streams)(ngtcp2_conn *conn,
+                                         uint64_t max_streams, void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_extend_max_stream_data` is a callback function which
+ * is invoked when max stream data is extended.  |stream_id|
+ * identifies the stream.  |max_data| is a cumulative number of bytes
+ * the endpoint can send on this stream.
+ *
+ * The callback function must return 0 if it succeeds.  Returning
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
+ * immediately.
+ */
+typedef int (*ngtcp2_extend_max_stream_data)(ngtcp2_conn *conn,
+                                             int64_t stream_id,
+                                             uint64_t max_data, void *user_data,
+                                             void *stream_user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_rand` is a callback function to get randomized byte
+ * string from application.  Application must fill random |destlen|
+ * bytes to the buffer pointed by |dest|.  The generated bytes are
+ * used only in non-cryptographic context.
+ */
+typedef void (*ngtcp2_rand)(uint8_t *dest, size_t destlen,
+                            const ngtcp2_rand_ctx *rand_ctx);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_get_new_connection_id` is a callback function to ask
+ * an application for new connection ID.  Application must generate
+ * new unused connection ID with the exact |cidlen| bytes and store it
+ * in |cid|.  It also has to generate stateless reset token into
+ * |token|.  The length of stateless reset token is
+ * :macro:`NGTCP2_STATELESS_RESET_TOKENLEN` and it is guaranteed that
+ * the buffer pointed by |cid| has the sufficient space to store the
+ * token.
+ *
+ * The callback function must return 0 if it succeeds.  Returning
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
+ * immediately.
+ */
+typedef int (*ngtcp2_get_new_connection_id)(ngtcp2_conn *conn, ngtcp2_cid *cid,
+                                            uint8_t *token, size_t cidlen,
+                                            void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_get_new_connection_ids` is a callback function to ask
+ * an application for |n| new connection IDs at once.  Application
+ * must generate |n| new unused connection IDs with the exact |cidlen|
+ * bytes and store them in |cids|, and their stateless reset tokens in
+ * |tokens|.  The token for ``cids[i]`` is stored at ``tokens + i *
+ * NGTCP2_STATELESS_RESET_TOKENLEN``.  The buffers pointed by |cids|
+ * and |tokens| have the sufficient space for |n| elements.  Server
+ * can derive connection IDs with `ngtcp2_crypto_cid_ctx_encrypt_cid`
+ * and their tokens with `ngtcp2_crypto_generate_stateless_reset_token`
+ * so that it does not have to remember each connection ID.
+ *
+ * The callback function must return 0 if it succeeds.  Returning
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
+ * immediately.
+ */
+typedef int (*ngtcp2_get_new_connection_ids)(ngtcp2_conn *conn,
+                                             ngtcp2_cid *cids, uint8_t *tokens,
+                                             size_t cidlen, size_t n,
+                                             void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_remove_connection_id` is a callback function which
+ * notifies the application that connection ID |cid| is no longer used
+ * by remote endpoint.
+ *
+ * The callback function must return 0 if it succeeds.  Returning
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
+ * immediately.
+ */
+typedef int (*ngtcp2_remove_connection_id)(ngtcp2_conn *conn,
+                                           const ngtcp2_cid *cid,
+                                           void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_update_key` is a callback function which tells the
+ * application that it must generate new packet protection keying
+ * materials and AEAD cipher context objects with new keys.  The
+ * current set of secrets are given as |current_rx_secret| and
+ * |current_tx_secret| of length |secretlen|.  They are decryption and
+ * encryption secrets respectively.
+ *
+ * The application has to generate new secrets and keys for both
+ * encryption and decryption, and write decryption secret and IV to
+ * the buffer pointed by |rx_secret| and |rx_iv| respectively.  It
+ * also has to create new AEAD cipher context object with new
+ * decryption key and initialize |rx_aead_ctx| with it.  Similarly,
+ * write encryption secret and IV to the buffer pointed by |tx_secret|
+ * and |tx_iv|.  Create new AEAD cipher context object with new
+ * encryption key and initialize |tx_aead_ctx| with it.  All given
+ * buffers have the enough capacity to store secret, key and IV.
+ *
+ * The callback function must return 0 if it succeeds.  Returning
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
+ * immediately.
+ */
+typedef int (*ngtcp2_update_key)(
+    ngtcp2_conn *conn, uint8_t *rx_secret, uint8_t *tx_secret,
+    ngtcp2_crypto_aead_ctx *rx_aead_ctx, uint8_t *rx_iv,
+    ngtcp2_crypto_aead_ctx *tx_aead_ctx, uint8_t *tx_iv,
+    const uint8_t *current_rx_secret, const uint8_t *current_tx_secret,
+    size_t secretlen, void *user_data);
+
+/**
+ * @macrosection
+ *
+ * Path validation related macros
+ */
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_PATH_VALIDATION_FLAG_NONE` indicates no flag set.
+ */
+#define NGTCP2_PATH_VALIDATION_FLAG_NONE 0x00u
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_PATH_VALIDATION_FLAG_PREFERRED_ADDR` indicates the
+ * validation involving server preferred address.  This flag is only
+ * set for client.
+ */
+#define NGTCP2_PATH_VALIDATION_FLAG_PREFERRED_ADDR 0x01u
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_path_validation` is a callback function which tells
+ * the application the outcome of path validation.  |flags| is zero or
+ * more of :macro:`NGTCP2_PATH_VALIDATION_FLAG_*
+ * <NGTCP2_PATH_VALIDATION_FLAG_NONE>`.  |path| is the path that was
+ * validated.  If |res| is
+ * :enum:`ngtcp2_path_validation_result.NGTCP2_PATH_VALIDATION_RESULT_SUCCESS`,
+ * the path validation succeeded.  If |res| is
+ * :enum:`ngtcp2_path_validation_result.NGTCP2_PATH_VALIDATION_RESULT_FAILURE`,
+ * the path validation failed.
+ *
+ * The callback function must return 0 if it succeeds.  Returning
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
+ * immediately.
+ */
+typedef int (*ngtcp2_path_validation)(ngtcp2_conn *conn, uint32_t flags,
+                                      const ngtcp2_path *path,
+                                      ngtcp2_path_validation_result res,
+                                      void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_select_preferred_addr` is a callback function which
+ * asks a client application to choose server address from preferred
+ * addresses |paddr| received from server.  An application should
+ * write a network path for a selected preferred address in |dest|.
+ * More specifically, the selected preferred address must be set to
+ * :member:`dest->remote <ngtcp2_path.remote>`, a client source
+ * address must be set to :member:`dest->local <ngtcp2_path.local>`.
+ * If a client source address does not change for the new server
+ * address, leave :member:`dest->local <ngtcp2_path.local>`
+ * unmodified, or copy the value of :member:`local
+ * <ngtcp2_path.local>` field of the current network path obtained
+ * from `ngtcp2_conn_get_path()`.  Both :member:`dest->local.addr
+ * <ngtcp2_addr.addr>` and :member:`dest->remote.addr
+ * <ngtcp2_addr.addr>` point to buffers which are at least
+ * ``sizeof(struct sockaddr_storage)`` bytes long, respectively.  If
+ * an application denies the preferred addresses, just leave |dest|
+ * unmodified (or set :member:`dest->remote.addrlen
+ * <ngtcp2_addr.addrlen>` to 0) and return 0.
+ *
+ * The callback function must return 0 if it succeeds.  Returning
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
+ * immediately.
+ */
+typedef int (*ngtcp2_select_preferred_addr)(ngtcp2_conn *conn,
+                                            ngtcp2_path *dest,
+                                            const ngtcp2_preferred_addr *paddr,
+                                            void *user_data);
+
+/**
+ * @enum
+ *
+ * :type:`ngtcp2_connection_id_status_type` defines a set of status
+ * for Destination Connection ID.
+ */
+typedef enum ngtcp2_connection_id_status_type {
+  /**
+   * :enum:`NGTCP2_CONNECTION_ID_STATUS_TYPE_ACTIVATE` indicates that
+   * a local endpoint starts using new destination Connection ID.
+   */
+  NGTCP2_CONNECTION_ID_STATUS_TYPE_ACTIVATE,
+  /**
+   * :enum:`NGTCP2_CONNECTION_ID_STATUS_TYPE_DEACTIVATE` indicates
+   * that a local endpoint stops using a given destination Connection
+   * ID.
+   */
+  NGTCP2_CONNECTION_ID_STATUS_TYPE_DEACTIVATE
+} ngtcp2_connection_id_status_type;
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_connection_id_status` is a callback function which is
+ * called when the status of Connection ID changes.
+ *
+ * |token| is the associated stateless reset token and it is ``NULL``
+ * if no token is present.
+ *
+ * |type| is the one of the value defined in
+ * :type:`ngtcp2_connection_id_status_type`.  The new value might be
+ * added in the future release.
+ *
+ * The callback function must return 0 if it succeeds.  Returning
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
+ * immediately.
+ */
+typedef int (*ngtcp2_connection_id_status)(ngtcp2_conn *conn, int type,
+                                           uint64_t seq, const ngtcp2_cid *cid,
+                                           const uint8_t *token,
+                                           void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_recv_new_token` is a callback function which is
+ * called when new token is received from server.
+ *
+ * |token| is the received token.
+ *
+ * The callback function must return 0 if it succeeds.  Returning
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
+ * immediately.
+ */
+typedef int (*ngtcp2_recv_new_token)(ngtcp2_conn *conn, const ngtcp2_vec *token,
+                                     void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_delete_crypto_aead_ctx` is a callback function which
+ * must delete the native object pointed by
+ * :member:`aead_ctx->native_handle
+ * <ngtcp2_crypto_aead_ctx.native_handle>`.
+ */
+typedef void (*ngtcp2_delete_crypto_aead_ctx)(ngtcp2_conn *conn,
+                                              ngtcp2_crypto_aead_ctx *aead_ctx,
+                                              void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_delete_crypto_cipher_ctx` is a callback function
+ * which must delete the native object pointed by
+ * :member:`cipher_ctx->native_handle
+ * <ngtcp2_crypto_cipher_ctx.native_handle>`.
+ */
+typedef void (*ngtcp2_delete_crypto_cipher_ctx)(
+    ngtcp2_conn *conn, ngtcp2_crypto_cipher_ctx *cipher_ctx, void *user_data);
+
+/**
+ * @macrosection
+ *
+ * Datagram flags
+ */
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_DATAGRAM_FLAG_NONE` indicates no flag set.
+ */
+#define NGTCP2_DATAGRAM_FLAG_NONE 0x00u
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_DATAGRAM_FLAG_EARLY` indicates that DATAGRAM frame
+ * is received in 0RTT packet and the handshake has not completed yet,
+ * which means that the data might be replayed.
+ */
+#define NGTCP2_DATAGRAM_FLAG_EARLY 0x01u
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_recv_datagram` is invoked when DATAGRAM frame is
+ * received.  |flags| is bitwise-OR of zero or more of
+ * :macro:`NGTCP2_DATAGRAM_FLAG_* <NGTCP2_DATAGRAM_FLAG_NONE>`.
+ *
+ * If :macro:`NGTCP2_DATAGRAM_FLAG_EARLY` is set in |flags|, it
+ * indicates that DATAGRAM frame was received in 0RTT packet and a
+ * handshake has not completed yet.
+ *
+ * The callback function must return 0 if it succeeds, or
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library return
+ * immediately.
+ */
+typedef int (*ngtcp2_recv_datagram)(ngtcp2_conn *conn, uint32_t flags,
+                                    const uint8_t *data, size_t datalen,
+                                    void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_ack_datagram` is invoked when a packet which contains
+ * DATAGRAM frame which is identified by |dgram_id| is acknowledged.
+ * |dgram_id| is the valued passed to `ngtcp2_conn_writev_datagram`
+ * or `ngtcp2_conn_enqueue_datagram`.
+ *
+ * The callback function must return 0 if it succeeds, or
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library return
+ * immediately.
+ */
+typedef int (*ngtcp2_ack_datagram)(ngtcp2_conn *conn, uint64_t dgram_id,
+                                   void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_lost_datagram` is invoked when a packet which
+ * contains DATAGRAM frame which is identified by |dgram_id| is
+ * declared lost.  |dgram_id| is the valued passed to
+ * `ngtcp2_conn_writev_datagram`.  Note that the loss might be
+ * spurious, and DATAGRAM frame might be acknowledged later.  It is
+ * also invoked when a DATAGRAM queued by
+ * `ngtcp2_conn_enqueue_datagram` is dropped without being sent.
+ *
+ * The callback function must return 0 if it succeeds, or
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` which makes the library return
+ * immediately.
+ */
+typedef int (*ngtcp2_lost_datagram)(ngtcp2_conn *conn, uint64_t dgram_id,
+                                    void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_get_path_challenge_data` is a callback function to
+ * ask an application for new data that is sent in PATH_CHALLENGE
+ * frame.  Application must generate new unpredictable exactly
+ * :macro:`NGTCP2_PATH_CHALLENGE_DATALEN` bytes of random data and
+ * store them into the buffer pointed by |data|.
+ *
+ * The callback function must return 0 if it succeeds.  Returning
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
+ * immediately.
+ */
+typedef int (*ngtcp2_get_path_challenge_data)(ngtcp2_conn *conn, uint8_t *data,
+                                              void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_stream_stop_sending` is invoked when a stream is no
+ * longer read by a local endpoint before it receives all stream data.
+ * This function is called at most once per stream.  |app_error_code|
+ * is the error code passed to `ngtcp2_conn_shutdown_stream_read` or
+ * `ngtcp2_conn_shutdown_stream`.
+ *
+ * The callback function must return 0 if it succeeds.  Returning
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
+ * immediately.
+ */
+typedef int (*ngtcp2_stream_stop_sending)(ngtcp2_conn *conn, int64_t stream_id,
+                                          uint64_t app_error_code,
+                                          void *user_data,
+                                          void *stream_user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_version_negotiation` is invoked when the compatible
+ * version negotiation takes place.  For client, it is called when it
+ * sees a change in version field of a long header packet.  This
+ * callback function might be called multiple times for client.  For
+ * server, it is called once when the version is negotiated.
+ *
+ * The implementation of this callback must install new Initial keys
+ * for |version|.  Use `ngtcp2_conn_install_vneg_initial_key` to
+ * install keys.
+ *
+ * The callback function must return 0 if it succeeds.  Returning
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
+ * immediately.
+ */
+typedef int (*ngtcp2_version_negotiation)(ngtcp2_conn *conn, uint32_t version,
+                                          const ngtcp2_cid *client_dcid,
+                                          void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_recv_key` is invoked when new key is installed to
+ * |conn| during QUIC cryptographic handshake.
+ *
+ * The callback function must return 0 if it succeeds.  Returning
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
+ * immediately.
+ */
+typedef int (*ngtcp2_recv_key)(ngtcp2_conn *conn, ngtcp2_crypto_level level,
+                               void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_offload_tx_key` is invoked when a 1RTT packet
+ * protection key is installed while
+ * :member:`ngtcp2_settings.crypto_offload` is enabled, so that the
+ * application can install the key into a NIC or a kernel.  |key_id|
+ * identifies the key, and it is 0 for the first 1RTT key, and is
+ * incremented by 1 for each key update.  |secret| of length
+ * |secretlen| is the traffic secret from which the key is derived.
+ * `ngtcp2_crypto_derive_offload_key` derives the key, IV, and header
+ * protection key from it.  The header protection key does not change
+ * by key update, and it is only derived from the secret of |key_id|
+ * 0.  The key of the next key phase is installed before it is used
+ * for the first time.  The application can remove the key of
+ * |key_id| - 1 from the device when the key of |key_id| + 1 is
+ * installed.
+ *
+ * The callback function must return 0 if it succeeds.  Returning
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE` makes the library call return
+ * immediately.
+ */
+typedef int (*ngtcp2_offload_tx_key)(ngtcp2_conn *conn, uint64_t key_id,
+                                     const uint8_t *secret, size_t secretlen,
+                                     void *user_data);
+
+#define NGTCP2_CALLBACKS_VERSION_V1 1
+#define NGTCP2_CALLBACKS_VERSION NGTCP2_CALLBACKS_VERSION_V1
+
+/**
+ * @struct
+ *
+ * :type:`ngtcp2_callbacks` holds a set of callback functions.
+ */
+typedef struct ngtcp2_callbacks {
+  /**
+   * :member:`client_initial` is a callback function which is invoked
+   * when client asks TLS stack to produce first TLS cryptographic
+   * handshake message.  This callback function must be specified for
+   * a client application.
+   */
+  ngtcp2_client_initial client_initial;
+  /**
+   * :member:`recv_client_initial` is a callback function which is
+   * invoked when a server receives the first packet from client.
+   * This callback function must be specified for a server application.
+   */
+  ngtcp2_recv_client_initial recv_client_initial;
+  /**
+   * :member:`recv_crypto_data` is a callback function which is
+   * invoked when cryptographic data (CRYPTO frame, in other words,
+   * TLS message) is received.  This callback function must be
+   * specified.
+   */
+  ngtcp2_recv_crypto_data recv_crypto_data;
+  /**
+   * :member:`handshake_completed` is a callback function which is
+   * invoked when QUIC cryptographic handshake has completed.  This
+   * callback function is optional.
+   */
+  ngtcp2_handshake_completed handshake_completed;
+  /**
+   * :member:`recv_version_negotiation` is a callback function which
+   * is invoked when Version Negotiation packet is received by a
+   * client.  This callback function is optional.
+   */
+  ngtcp2_recv_version_negotiation recv_version_negotiation;
+  /**
+   * :member:`encrypt` is a callback function which is invoked to
+   * encrypt a QUIC packet.  This callback function must be specified.
+   */
+  ngtcp2_encrypt encrypt;
+  /**
+   * :member:`decrypt` is a callback function which is invoked to
+   * decrypt a QUIC packet.  This callback function must be specified.
+   */
+  ngtcp2_decrypt decrypt;
+  /**
+   * :member:`hp_mask` is a callback function which is invoked to get
+   * a mask to encrypt or decrypt packet header.  This callback
+   * function must be specified.
+   */
+  ngtcp2_hp_mask hp_mask;
+  /**
+   * :member:`recv_stream_data` is a callback function which is
+   * invoked when STREAM data, which includes application data, is
+   * received.  This callback function is optional.
+   */
+  ngtcp2_recv_stream_data recv_stream_data;
+  /**
+   * :member:`acked_stream_data_offset` is a callback function which
+   * is invoked when STREAM data, which includes application data, is
+   * acknowledged by a remote endpoint.  It tells an application the
+   * largest offset of acknowledged STREAM data without a gap so that
+   * application can free memory for the data.  This callback function
+   * is optional.
+   */
+  ngtcp2_acked_stream_data_offset acked_stream_data_offset;
+  /**
+   * :member:`stream_open` is a callback function which is invoked
+   * when new remote stream is opened by a remote endpoint.  This
+   * callback function is optional.
    */
   ngtcp2_stream_open stream_open;
   /**
@@ -3438,7 +5181,8 @@ typedef struct ngtcp2_callbacks {
   /**
    * :member:`get_new_connection_id` is a callback function which is
    * invoked when the library needs new connection ID.  This callback
-   * function must be specified.
+   * function must be specified unless
+   * :member:`get_new_connection_ids` is specified.
    */
   ngtcp2_get_new_connection_id get_new_connection_id;
   /**
@@ -3578,428 +5322,1814 @@ typedef struct ngtcp2_callbacks {
    * :enum:`ngtcp2_crypto_level.NGTCP2_CRYPTO_LEVEL_INITIAL`.
    */
   ngtcp2_recv_key recv_tx_key;
+  /**
+   * :member:`encrypt_batch` is a callback function which is invoked
+   * to encrypt 1RTT packets in bulk.  This callback function is
+   * optional.  If it is specified, the protection of 1RTT packets is
+   * deferred until `ngtcp2_conn_protect_pkts` is called.  See
+   * `ngtcp2_conn_protect_pkts` for details.
+   */
+  ngtcp2_encrypt_batch encrypt_batch;
+  /**
+   * :member:`hp_mask_batch` is a callback function which is invoked
+   * to produce header protection masks in bulk.  This callback
+   * function is optional.  It is used to protect the packets deferred
+   * by :member:`encrypt_batch`, and to remove header protection of the
+   * packets passed to `ngtcp2_conn_prepare_rx_hp_masks`.  If it is
+   * not specified, :member:`hp_mask` is called for each packet
+   * instead.
+   */
+  ngtcp2_hp_mask_batch hp_mask_batch;
+  /**
+   * :member:`release_stream_buf` is a callback function which is
+   * invoked when an application buffer attached by
+   * `ngtcp2_conn_attach_stream_buf` is no longer referenced.  This
+   * callback function is optional.
+   */
+  ngtcp2_release_stream_buf release_stream_buf;
+  /**
+   * :member:`get_new_connection_ids` is a callback function which is
+   * invoked when the library needs new connection IDs.  This callback
+   * function is optional.  If it is specified, it is called instead
+   * of :member:`get_new_connection_id` to get all connection IDs
+   * needed at once, and :member:`get_new_connection_id` may be
+   * ``NULL``.
+   */
+  ngtcp2_get_new_connection_ids get_new_connection_ids;
+  /**
+   * :member:`encrypt_hp_mask` is a callback function which encrypts
+   * a packet payload and produces its header protection mask at
+   * once.  This callback function is optional.  If it is specified,
+   * it is used instead of :member:`encrypt` and :member:`hp_mask`
+   * when a packet is finalized without deferred protection.
+   * :member:`encrypt` and :member:`hp_mask` must still be specified.
+   */
+  ngtcp2_encrypt_hp_mask encrypt_hp_mask;
+  /**
+   * :member:`encrypt_vec` is a callback function which encrypts a
+   * packet payload scattered over multiple buffers.  This callback
+   * function is optional.  If it is specified, the library does not
+   * copy STREAM data into a packet which is protected without
+   * deferral, and passes it to this callback along with the rest of
+   * the payload.  It takes precedence over :member:`encrypt_hp_mask`
+   * for such packets.
+   */
+  ngtcp2_encrypt_vec encrypt_vec;
+  /**
+   * :member:`offload_tx_key` is a callback function which is invoked
+   * when a 1RTT packet protection key is installed while
+   * :member:`ngtcp2_settings.crypto_offload` is enabled.  This
+   * callback function is optional.
+   */
+  ngtcp2_offload_tx_key offload_tx_key;
 } ngtcp2_callbacks;
 
+/**
+ * @struct
+ *
+ * :type:`ngtcp2_cc_pkt` is a convenient structure to include
+ * acked/lost/sent packet.
+ */
+typedef struct ngtcp2_cc_pkt {
+  /**
+   * :member:`pkt_num` is the packet number
+   */
+  int64_t pkt_num;
+  /**
+   * :member:`pktlen` is the length of packet.
+   */
+  size_t pktlen;
+  /**
+   * :member:`pktns_id` is the ID of packet number space which this
+   * packet belongs to.
+   */
+  ngtcp2_pktns_id pktns_id;
+  /**
+   * :member:`sent_ts` is the timestamp when packet is sent.
+   */
+  ngtcp2_tstamp sent_ts;
+  /**
+   * :member:`lost` is the number of bytes lost when this packet was
+   * sent.
+   */
+  uint64_t lost;
+  /**
+   * :member:`tx_in_flight` is the bytes in flight when this packet
+   * was sent.
+   */
+  uint64_t tx_in_flight;
+  /**
+   * :member:`is_app_limited` is nonzero if the connection is
+   * app-limited when this packet was sent.
+   */
+  int is_app_limited;
+} ngtcp2_cc_pkt;
+
+/**
+ * @struct
+ *
+ * :type:`ngtcp2_cc_ack` is a convenient structure which stores
+ * acknowledged and lost bytes.
+ */
+typedef struct ngtcp2_cc_ack {
+  /**
+   * :member:`prior_bytes_in_flight` is the in-flight bytes before
+   * processing this ACK.
+   */
+  uint64_t prior_bytes_in_flight;
+  /**
+   * :member:`bytes_delivered` is the number of bytes acknowledged.
+   */
+  uint64_t bytes_delivered;
+  /**
+   * :member:`bytes_lost` is the number of bytes declared lost.
+   */
+  uint64_t bytes_lost;
+  /**
+   * :member:`pkt_delivered` is the cumulative acknowledged bytes when
+   * the last packet acknowledged by this ACK was sent.
+   */
+  uint64_t pkt_delivered;
+  /**
+   * :member:`largest_acked_sent_ts` is the time when the largest
+   * acknowledged packet was sent.
+   */
+  ngtcp2_tstamp largest_acked_sent_ts;
+  /**
+   * :member:`rtt` is the RTT sample.  It is UINT64_MAX if no RTT
+   * sample is available.
+   */
+  ngtcp2_duration rtt;
+} ngtcp2_cc_ack;
+
+/**
+ * @struct
+ *
+ * :type:`ngtcp2_rate_sample` is a delivery rate sample which is
+ * computed from an acknowledgement.
+ */
+typedef struct ngtcp2_rate_sample {
+  /**
+   * :member:`interval` is the length of time over which
+   * :member:`delivered` was measured.
+   */
+  ngtcp2_duration interval;
+  /**
+   * :member:`delivered` is the number of bytes delivered over
+   * :member:`interval`.
+   */
+  uint64_t delivered;
+  /**
+   * :member:`prior_delivered` is the cumulative delivered bytes
+   * when the most recently acknowledged packet was sent.
+   */
+  uint64_t prior_delivered;
+  /**
+   * :member:`prior_ts` is the time when :member:`prior_delivered`
+   * was recorded.
+   */
+  ngtcp2_tstamp prior_ts;
+  /**
+   * :member:`tx_in_flight` is the bytes in flight when the most
+   * recently acknowledged packet was sent.
+   */
+  uint64_t tx_in_flight;
+  /**
+   * :member:`lost` is the number of bytes lost over
+   * :member:`interval`.
+   */
+  uint64_t lost;
+  /**
+   * :member:`prior_lost` is the cumulative lost bytes when the most
+   * recently acknowledged packet was sent.
+   */
+  uint64_t prior_lost;
+  /**
+   * :member:`send_elapsed` is the send time interval of the sample.
+   */
+  ngtcp2_duration send_elapsed;
+  /**
+   * :member:`ack_elapsed` is the acknowledgement time interval of
+   * the sample.
+   */
+  ngtcp2_duration ack_elapsed;
+  /**
+   * :member:`is_app_limited` is nonzero if the sample is taken while
+   * the connection is app-limited.
+   */
+  int is_app_limited;
+} ngtcp2_rate_sample;
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_user_cc_on_pkt_acked` is invoked when a packet |pkt|
+ * is acknowledged.
+ */
+typedef void (*ngtcp2_user_cc_on_pkt_acked)(ngtcp2_conn *conn,
+                                            ngtcp2_conn_stat *cstat,
+                                            const ngtcp2_cc_pkt *pkt,
+                                            ngtcp2_tstamp ts,
+                                            void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_user_cc_on_pkt_lost` is invoked when a packet |pkt| is
+ * declared lost.
+ */
+typedef void (*ngtcp2_user_cc_on_pkt_lost)(ngtcp2_conn *conn,
+                                           ngtcp2_conn_stat *cstat,
+                                           const ngtcp2_cc_pkt *pkt,
+                                           ngtcp2_tstamp ts,
+                                           void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_user_cc_congestion_event` is invoked when a congestion
+ * event happens, that is packet loss is detected or CE marking is
+ * reported.  |sent_ts| is the time when the packet which triggered
+ * the event was sent.
+ */
+typedef void (*ngtcp2_user_cc_congestion_event)(ngtcp2_conn *conn,
+                                                ngtcp2_conn_stat *cstat,
+                                                ngtcp2_tstamp sent_ts,
+                                                ngtcp2_tstamp ts,
+                                                void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_user_cc_on_spurious_congestion` is invoked when all
+ * packets which were declared lost turn out to be acknowledged.
+ */
+typedef void (*ngtcp2_user_cc_on_spurious_congestion)(ngtcp2_conn *conn,
+                                                      ngtcp2_conn_stat *cstat,
+                                                      ngtcp2_tstamp ts,
+                                                      void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_user_cc_on_persistent_congestion` is invoked when
+ * persistent congestion is established.
+ */
+typedef void (*ngtcp2_user_cc_on_persistent_congestion)(
+    ngtcp2_conn *conn, ngtcp2_conn_stat *cstat, ngtcp2_tstamp ts,
+    void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_user_cc_on_ack_recv` is invoked when an
+ * acknowledgement is received, after all acknowledged and lost
+ * packets are processed.  |rs| is the latest delivery rate sample.
+ */
+typedef void (*ngtcp2_user_cc_on_ack_recv)(ngtcp2_conn *conn,
+                                           ngtcp2_conn_stat *cstat,
+                                           const ngtcp2_cc_ack *ack,
+                                           const ngtcp2_rate_sample *rs,
+                                           ngtcp2_tstamp ts,
+                                           void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_user_cc_on_pkt_sent` is invoked when an ack-eliciting
+ * packet |pkt| is sent.
+ */
+typedef void (*ngtcp2_user_cc_on_pkt_sent)(ngtcp2_conn *conn,
+                                           ngtcp2_conn_stat *cstat,
+                                           const ngtcp2_cc_pkt *pkt,
+                                           void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_user_cc_new_rtt_sample` is invoked when a new RTT
+ * sample is obtained.  The sample is
+ * :member:`ngtcp2_conn_stat.latest_rtt`.
+ */
+typedef void (*ngtcp2_user_cc_new_rtt_sample)(ngtcp2_conn *conn,
+                                              ngtcp2_conn_stat *cstat,
+                                              ngtcp2_tstamp ts,
+                                              void *user_data);
+
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_user_cc_reset` is invoked when the congestion control
+ * state must be reset, e.g., when the connection migrates to a new
+ * path.  |cstat| has already been reset to the initial values.
+ */
+typedef void (*ngtcp2_user_cc_reset)(ngtcp2_conn *conn,
+                                     ngtcp2_conn_stat *cstat,
+                                     ngtcp2_tstamp ts, void *user_data);
+
+#define NGTCP2_CC_CALLBACKS_VERSION_V1 1
+#define NGTCP2_CC_CALLBACKS_VERSION NGTCP2_CC_CALLBACKS_VERSION_V1
+
+/**
+ * @struct
+ *
+ * :type:`ngtcp2_cc_callbacks` is a congestion controller implemented
+ * by application.  It is installed by `ngtcp2_conn_set_cc_callbacks`.
+ * The callback functions adjust the fields of
+ * :type:`ngtcp2_conn_stat` that govern sending, that is
+ * :member:`ngtcp2_conn_stat.cwnd`,
+ * :member:`ngtcp2_conn_stat.ssthresh`,
+ * :member:`ngtcp2_conn_stat.congestion_recovery_start_ts`,
+ * :member:`ngtcp2_conn_stat.pacing_rate`, and
+ * :member:`ngtcp2_conn_stat.send_quantum`.  The other fields are
+ * maintained by the library and must not be changed.  |user_data|
+ * passed to the callback functions is the one given to
+ * `ngtcp2_conn_client_new` or `ngtcp2_conn_server_new`.  Any callback
+ * function may be NULL.
+ */
+typedef struct ngtcp2_cc_callbacks {
+  /**
+   * :member:`on_pkt_acked` is a callback function which is called
+   * when a packet is acknowledged.
+   */
+  ngtcp2_user_cc_on_pkt_acked on_pkt_acked;
+  /**
+   * :member:`on_pkt_lost` is a callback function which is called when
+   * a packet is declared lost.
+   */
+  ngtcp2_user_cc_on_pkt_lost on_pkt_lost;
+  /**
+   * :member:`congestion_event` is a callback function which is called
+   * when a congestion event happens.
+   */
+  ngtcp2_user_cc_congestion_event congestion_event;
+  /**
+   * :member:`on_spurious_congestion` is a callback function which is
+   * called when a spurious congestion is detected.
+   */
+  ngtcp2_user_cc_on_spurious_congestion on_spurious_congestion;
+  /**
+   * :member:`on_persistent_congestion` is a callback function which
+   * is called when persistent congestion is established.
+   */
+  ngtcp2_user_cc_on_persistent_congestion on_persistent_congestion;
+  /**
+   * :member:`on_ack_recv` is a callback function which is called when
+   * an acknowledgement is received.
+   */
+  ngtcp2_user_cc_on_ack_recv on_ack_recv;
+  /**
+   * :member:`on_pkt_sent` is a callback function which is called when
+   * an ack-eliciting packet is sent.
+   */
+  ngtcp2_user_cc_on_pkt_sent on_pkt_sent;
+  /**
+   * :member:`new_rtt_sample` is a callback function which is called
+   * when a new RTT sample is obtained.
+   */
+  ngtcp2_user_cc_new_rtt_sample new_rtt_sample;
+  /**
+   * :member:`reset` is a callback function which is called when the
+   * congestion control state must be reset.  It is also called when
+   * the congestion controller is installed.
+   */
+  ngtcp2_user_cc_reset reset;
+} ngtcp2_cc_callbacks;
+
+/**
+ * @function
+ *
+ * `ngtcp2_pkt_write_connection_close` writes Initial packet
+ * containing CONNECTION_CLOSE frame with the given |error_code| and
+ * the optional |reason| of length |reasonlen| to the buffer pointed
+ * by |dest| of length |destlen|.  All encryption parameters are for
+ * Initial packet encryption.  The packet number is always 0.
+ *
+ * The primary use case of this function is for server to send
+ * CONNECTION_CLOSE frame in Initial packet to close connection
+ * without committing the state when validating Retry token fails.
+ *
+ * This function returns the number of bytes written if it succeeds,
+ * or one of the following negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOBUF`
+ *     Buffer is too small.
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`
+ *     Callback function failed.
+ */
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_pkt_write_connection_close(
+    uint8_t *dest, size_t destlen, uint32_t version, const ngtcp2_cid *dcid,
+    const ngtcp2_cid *scid, uint64_t error_code, const uint8_t *reason,
+    size_t reasonlen, ngtcp2_encrypt encrypt, const ngtcp2_crypto_aead *aead,
+    const ngtcp2_crypto_aead_ctx *aead_ctx, const uint8_t *iv,
+    ngtcp2_hp_mask hp_mask, const ngtcp2_crypto_cipher *hp,
+    const ngtcp2_crypto_cipher_ctx *hp_ctx);
+
+/**
+ * @function
+ *
+ * `ngtcp2_pkt_write_retry` writes Retry packet in the buffer pointed
+ * by |dest| whose length is |destlen|.  |dcid| is the destination
+ * connection ID which appeared in a packet as a source connection ID
+ * sent by client.  |scid| is a server chosen source connection ID.
+ * |odcid| specifies Original Destination Connection ID which appeared
+ * in a packet as a destination connection ID sent by client.  |token|
+ * specifies Retry Token, and |tokenlen| specifies its length.  |aead|
+ * must be AEAD_AES_128_GCM.  |aead_ctx| must be initialized with
+ * :macro:`NGTCP2_RETRY_KEY` as an encryption key.
+ *
+ * This function returns the number of bytes written to the buffer, or
+ * one of the following negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOBUF`
+ *     Buffer is too small.
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`
+ *     Callback function failed.
+ * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     :member:`odcid->datalen <ngtcp2_cid.datalen>` is less than
+ *     :macro:`NGTCP2_MIN_INITIAL_DCIDLEN`.
+ */
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_pkt_write_retry(
+    uint8_t *dest, size_t destlen, uint32_t version, const ngtcp2_cid *dcid,
+    const ngtcp2_cid *scid, const ngtcp2_cid *odcid, const uint8_t *token,
+    size_t tokenlen, ngtcp2_encrypt encrypt, const ngtcp2_crypto_aead *aead,
+    const ngtcp2_crypto_aead_ctx *aead_ctx);
+
+/**
+ * @function
+ *
+ * `ngtcp2_accept` is used by server implementation, and decides
+ * whether packet |pkt| of length |pktlen| from client is acceptable
+ * for the very initial packet to a connection.
+ *
+ * If |dest| is not ``NULL`` and the function returns 0, or
+ * :macro:`NGTCP2_ERR_RETRY`, the decoded packet header is stored to
+ * the object pointed by |dest|.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_RETRY`
+ *     Retry packet should be sent.
+ * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     The packet is not acceptable for the very first packet to a new
+ *     connection; or the function failed to parse the packet header.
+ */
+NGTCP2_EXTERN int ngtcp2_accept(ngtcp2_pkt_hd *dest, const uint8_t *pkt,
+                                size_t pktlen);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_client_new` creates new :type:`ngtcp2_conn`, and
+ * initializes it as client.  |dcid| is randomized destination
+ * connection ID.  |scid| is source connection ID.
+ * |client_chosen_version| is a QUIC version that a client chooses.
+ * |path| is the network path where this QUIC connection is being
+ * established and must not be ``NULL``.  |callbacks|, |settings|, and
+ * |params| must not be ``NULL``, and the function make a copy of each
+ * of them.  |params| is local QUIC transport parameters and sent to a
+ * remote endpoint during handshake.  |user_data| is the arbitrary
+ * pointer which is passed to the user-defined callback functions.  If
+ * |mem| is ``NULL``, the memory allocator returned by
+ * `ngtcp2_mem_default()` is used.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
+ * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     The library is built without client support.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_client_new_versioned(
+    ngtcp2_conn **pconn, const ngtcp2_cid *dcid, const ngtcp2_cid *scid,
+    const ngtcp2_path *path, uint32_t client_chosen_version,
+    int callbacks_version, const ngtcp2_callbacks *callbacks,
+    int settings_version, const ngtcp2_settings *settings,
+    int transport_params_version, const ngtcp2_transport_params *params,
+    const ngtcp2_mem *mem, void *user_data);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_server_new` creates new :type:`ngtcp2_conn`, and
+ * initializes it as server.  |dcid| is a destination connection ID.
+ * |scid| is a source connection ID.  |path| is the network path where
+ * this QUIC connection is being established and must not be ``NULL``.
+ * |client_chosen_version| is a QUIC version that a client chooses.
+ * |callbacks|, |settings|, and |params| must not be ``NULL``, and the
+ * function make a copy of each of them.  |params| is local QUIC
+ * transport parameters and sent to a remote endpoint during
+ * handshake.  |user_data| is the arbitrary pointer which is passed to
+ * the user-defined callback functions.  If |mem| is ``NULL``, the
+ * memory allocator returned by `ngtcp2_mem_default()` is used.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
+ * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     The library is built without server support.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_server_new_versioned(
+    ngtcp2_conn **pconn, const ngtcp2_cid *dcid, const ngtcp2_cid *scid,
+    const ngtcp2_path *path, uint32_t client_chosen_version,
+    int callbacks_version, const ngtcp2_callbacks *callbacks,
+    int settings_version, const ngtcp2_settings *settings,
+    int transport_params_version, const ngtcp2_transport_params *params,
+    const ngtcp2_mem *mem, void *user_data);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_del` frees resources allocated for |conn|.  It also
+ * frees memory pointed by |conn|.
+ */
+NGTCP2_EXTERN void ngtcp2_conn_del(ngtcp2_conn *conn);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_read_pkt` decrypts QUIC packet given in |pkt| of
+ * length |pktlen| and processes it.  |path| is the network path the
+ * packet is delivered and must not be ``NULL``.  |pi| is packet
+ * metadata and may be ``NULL``. This function performs QUIC handshake
+ * as well.
+ *
+ * This function must not be called from inside the callback
+ * functions.
+ *
+ * This function returns 0 if it succeeds, or negative error codes.
+ * If :macro:`NGTCP2_ERR_RETRY` is returned, application must be a
+ * server and it must perform address validation by sending Retry
+ * packet and discard the connection state.  If
+ * :macro:`NGTCP2_ERR_DROP_CONN` is returned, server application must
+ * drop the connection silently (without sending any CONNECTION_CLOSE
+ * frame) and discard connection state.  If
+ * :macro:`NGTCP2_ERR_DRAINING` is returned, a connection has entered
+ * the draining state, and no further packet transmission is allowed.
+ * If :macro:`NGTCP2_ERR_CRYPTO` is returned, the error happened in
+ * TLS stack and `ngtcp2_conn_get_tls_alert` returns TLS alert if set.
+ *
+ * If any other negative errors are returned, call
+ * `ngtcp2_conn_write_connection_close` to get terminal packet, and
+ * sending it makes QUIC connection enter the closing state.
+ */
+NGTCP2_EXTERN int
+ngtcp2_conn_read_pkt_versioned(ngtcp2_conn *conn, const ngtcp2_path *path,
+                               int pkt_info_version, const ngtcp2_pkt_info *pi,
+                               const uint8_t *pkt, size_t pktlen,
+                               ngtcp2_tstamp ts);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_read_pkts` is similar to `ngtcp2_conn_read_pkt`, but
+ * |pkt| of length |pktlen| contains one or more UDP datagrams which
+ * share the same |path|, |pi|, and |ts|, typically received at once
+ * with UDP_GRO.  Each datagram is |segsize| bytes long, except for
+ * the last one which may be shorter.  |segsize| must not be 0.
+ *
+ * This function is more efficient than calling `ngtcp2_conn_read_pkt`
+ * for each datagram because the bookkeeping shared by them is done
+ * only once.
+ *
+ * This function returns 0 if it succeeds, or the same negative error
+ * codes that `ngtcp2_conn_read_pkt` returns.  If an error occurs, the
+ * datagrams that follow the failed one are not processed.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_read_pkts_versioned(
+    ngtcp2_conn *conn, const ngtcp2_path *path, int pkt_info_version,
+    const ngtcp2_pkt_info *pi, const uint8_t *pkt, size_t pktlen,
+    size_t segsize, ngtcp2_tstamp ts);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_prefetch` hints the CPU to start loading the state of
+ * |conn| which `ngtcp2_conn_read_pkt` touches first into cache.  It
+ * does not change |conn|, and does nothing if the compiler has no
+ * prefetch intrinsic.
+ *
+ * It is meant to be called for the connection of the next group of
+ * datagrams while the current group is processed, so that the memory
+ * latency overlaps with useful work.  See `ngtcp2_pkt_group_by_dcid`.
+ */
+NGTCP2_EXTERN void ngtcp2_conn_prefetch(const ngtcp2_conn *conn);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_write_pkt` is equivalent to calling
+ * `ngtcp2_conn_writev_stream` with -1 as stream_id, no stream data, and
+ * :macro:`NGTCP2_WRITE_STREAM_FLAG_NONE` as flags.
+ */
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_conn_write_pkt_versioned(
+    ngtcp2_conn *conn, ngtcp2_path *path, int pkt_info_version,
+    ngtcp2_pkt_info *pi, uint8_t *dest, size_t destlen, ngtcp2_tstamp ts);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_handshake_completed` tells |conn| that the TLS stack
+ * declares TLS handshake completion.  This does not mean QUIC
+ * handshake has completed.  The library needs extra conditions to be
+ * met.
+ */
+NGTCP2_EXTERN void ngtcp2_conn_handshake_completed(ngtcp2_conn *conn);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_get_handshake_completed` returns nonzero if QUIC handshake
+ * has completed.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_get_handshake_completed(ngtcp2_conn *conn);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_install_initial_key` installs packet protection keying
+ * materials for Initial packets.  |rx_aead_ctx| is AEAD cipher
+ * context object and must be initialized with a decryption key.
+ * |rx_iv| is IV of length |rx_ivlen| for decryption.  |rx_hp_ctx| is
+ * a packet header protection cipher context object for decryption.
+ * Similarly, |tx_aead_ctx|, |tx_iv| and |tx_hp_ctx| are for
+ * encrypting outgoing packets and are the same length with the
+ * decryption counterpart .  If they have already been set, they are
+ * overwritten.
+ *
+ * |ivlen| must be the minimum length of AEAD nonce, or 8 bytes if
+ * that is larger.
+ *
+ * If this function succeeds, |conn| takes ownership of |rx_aead_ctx|,
+ * |rx_hp_ctx|, |tx_aead_ctx|, and |tx_hp_ctx|.
+ * :type:`ngtcp2_delete_crypto_aead_ctx` and
+ * :type:`ngtcp2_delete_crypto_cipher_ctx` will be called to delete
+ * these objects when they are no longer used.  If this function
+ * fails, the caller is responsible to delete them.
+ *
+ * After receiving Retry packet, the DCID most likely changes.  In
+ * that case, client application must generate these keying materials
+ * again based on new DCID and install them again.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_install_initial_key(
+    ngtcp2_conn *conn, const ngtcp2_crypto_aead_ctx *rx_aead_ctx,
+    const uint8_t *rx_iv, const ngtcp2_crypto_cipher_ctx *rx_hp_ctx,
+    const ngtcp2_crypto_aead_ctx *tx_aead_ctx, const uint8_t *tx_iv,
+    const ngtcp2_crypto_cipher_ctx *tx_hp_ctx, size_t ivlen);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_install_vneg_initial_key` installs packet protection
+ * keying materials for Initial packets on compatible version
+ * negotiation for |version|.  |rx_aead_ctx| is AEAD cipher context
+ * object and must be initialized with a decryption key.  |rx_iv| is
+ * IV of length |rx_ivlen| for decryption.  |rx_hp_ctx| is a packet
+ * header protection cipher context object for decryption.  Similarly,
+ * |tx_aead_ctx|, |tx_iv| and |tx_hp_ctx| are for encrypting outgoing
+ * packets and are the same length with the decryption counterpart .
+ * If they have already been set, they are overwritten.
+ *
+ * |ivlen| must be the minimum length of AEAD nonce, or 8 bytes if
+ * that is larger.
+ *
+ * If this function succeeds, |conn| takes ownership of |rx_aead_ctx|,
+ * |rx_hp_ctx|, |tx_aead_ctx|, and |tx_hp_ctx|.
+ * :type:`ngtcp2_delete_crypto_aead_ctx` and
+ * :type:`ngtcp2_delete_crypto_cipher_ctx` will be called to delete
+ * these objects when they are no longer used.  If this function
+ * fails, the caller is responsible to delete them.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_install_vneg_initial_key(
+    ngtcp2_conn *conn, uint32_t version,
+    const ngtcp2_crypto_aead_ctx *rx_aead_ctx, const uint8_t *rx_iv,
+    const ngtcp2_crypto_cipher_ctx *rx_hp_ctx,
+    const ngtcp2_crypto_aead_ctx *tx_aead_ctx, const uint8_t *tx_iv,
+    const ngtcp2_crypto_cipher_ctx *tx_hp_ctx, size_t ivlen);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_install_rx_handshake_key` installs packet protection
+ * keying materials for decrypting incoming Handshake packets.
+ * |aead_ctx| is AEAD cipher context object which must be initialized
+ * with a decryption key.  |iv| is IV of length |ivlen|.  |hp_ctx| is
+ * a packet header protection cipher context object.
+ *
+ * |ivlen| must be the minimum length of AEAD nonce, or 8 bytes if
+ * that is larger.
+ *
+ * If this function succeeds, |conn| takes ownership of |aead_ctx|,
+ * and |hp_ctx|.  :type:`ngtcp2_delete_crypto_aead_ctx` and
+ * :type:`ngtcp2_delete_crypto_cipher_ctx` will be called to delete
+ * these objects when they are no longer used.  If this function
+ * fails, the caller is responsible to delete them.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_install_rx_handshake_key(
+    ngtcp2_conn *conn, const ngtcp2_crypto_aead_ctx *aead_ctx,
+    const uint8_t *iv, size_t ivlen, const ngtcp2_crypto_cipher_ctx *hp_ctx);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_install_tx_handshake_key` installs packet protection
+ * keying materials for encrypting outgoing Handshake packets.
+ * |aead_ctx| is AEAD cipher context object which must be initialized
+ * with an encryption key.  |iv| is IV of length |ivlen|.  |hp_ctx| is
+ * a packet header protection cipher context object.
+ *
+ * |ivlen| must be the minimum length of AEAD nonce, or 8 bytes if
+ * that is larger.
+ *
+ * If this function succeeds, |conn| takes ownership of |aead_ctx| and
+ * |hp_ctx|.  :type:`ngtcp2_delete_crypto_aead_ctx` and
+ * :type:`ngtcp2_delete_crypto_cipher_ctx` will be called to delete
+ * these objects when they are no longer used.  If this function
+ * fails, the caller is responsible to delete them.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_install_tx_handshake_key(
+    ngtcp2_conn *conn, const ngtcp2_crypto_aead_ctx *aead_ctx,
+    const uint8_t *iv, size_t ivlen, const ngtcp2_crypto_cipher_ctx *hp_ctx);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_install_early_key` installs packet protection AEAD
+ * cipher context object |aead_ctx|, IV |iv| of length |ivlen|, and
+ * packet header protection cipher context object |hp_ctx| to encrypt
+ * (for client) or decrypt (for server) 0RTT packets.
+ *
+ * |ivlen| must be the minimum length of AEAD nonce, or 8 bytes if
+ * that is larger.
+ *
+ * If this function succeeds, |conn| takes ownership of |aead_ctx| and
+ * |hp_ctx|.  :type:`ngtcp2_delete_crypto_aead_ctx` and
+ * :type:`ngtcp2_delete_crypto_cipher_ctx` will be called to delete
+ * these objects when they are no longer used.  If this function
+ * fails, the caller is responsible to delete them.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_install_early_key(
+    ngtcp2_conn *conn, const ngtcp2_crypto_aead_ctx *aead_ctx,
+    const uint8_t *iv, size_t ivlen, const ngtcp2_crypto_cipher_ctx *hp_ctx);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_install_rx_key` installs packet protection keying
+ * materials for decrypting Short header packets.  |secret| of length
+ * |secretlen| is the decryption secret which is used to derive keying
+ * materials passed to this function.  |aead_ctx| is AEAD cipher
+ * context object which must be initialized with a decryption key.
+ * |iv| is IV of length |ivlen|.  |hp_ctx| is a packet header
+ * protection cipher context object.
+ *
+ * |ivlen| must be the minimum length of AEAD nonce, or 8 bytes if
+ * that is larger.
+ *
+ * If this function succeeds, |conn| takes ownership of |aead_ctx| and
+ * |hp_ctx|.  :type:`ngtcp2_delete_crypto_aead_ctx` and
+ * :type:`ngtcp2_delete_crypto_cipher_ctx` will be called to delete
+ * these objects when they are no longer used.  If this function
+ * fails, the caller is responsible to delete them.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_install_rx_key(
+    ngtcp2_conn *conn, const uint8_t *secret, size_t secretlen,
+    const ngtcp2_crypto_aead_ctx *aead_ctx, const uint8_t *iv, size_t ivlen,
+    const ngtcp2_crypto_cipher_ctx *hp_ctx);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_install_tx_key` installs packet protection keying
+ * materials for encrypting Short header packets.  |secret| of length
+ * |secretlen| is the encryption secret which is used to derive keying
+ * materials passed to this function.  |aead_ctx| is AEAD cipher
+ * context object which must be initialized with an encryption key.
+ * |iv| is IV of length |ivlen|.  |hp_ctx| is a packet header
+ * protection cipher context object.
+ *
+ * |ivlen| must be the minimum length of AEAD nonce, or 8 bytes if
+ * that is larger.
+ *
+ * If this function succeeds, |conn| takes ownership of |aead_ctx| and
+ * |hp_ctx|.  :type:`ngtcp2_delete_crypto_aead_ctx` and
+ * :type:`ngtcp2_delete_crypto_cipher_ctx` will be called to delete
+ * these objects when they are no longer used.  If this function
+ * fails, the caller is responsible to delete them.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_install_tx_key(
+    ngtcp2_conn *conn, const uint8_t *secret, size_t secretlen,
+    const ngtcp2_crypto_aead_ctx *aead_ctx, const uint8_t *iv, size_t ivlen,
+    const ngtcp2_crypto_cipher_ctx *hp_ctx);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_prepare_key_update` derives the keys of the next key
+ * phase by calling :member:`ngtcp2_callbacks.update_key` if they are
+ * due and not derived yet.  The library does this from
+ * `ngtcp2_conn_read_pkt` and `ngtcp2_conn_writev_stream` as well.
+ * Calling this function when the application is otherwise idle
+ * keeps the derivation off the packet processing path.  Together
+ * with :member:`ngtcp2_settings.eager_key_update`, the keys are
+ * ready long before they are needed.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_INVALID_STATE`
+ *     The handshake has not completed, or the connection is closing
+ *     or draining.
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`
+ *     User-defined callback function failed.
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
+ * :macro:`NGTCP2_ERR_AEAD_LIMIT_REACHED`
+ *     The confidentiality limit of the current key has been reached,
+ *     and key update cannot be initiated.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_prepare_key_update(ngtcp2_conn *conn,
+                                                 ngtcp2_tstamp ts);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_initiate_key_update` initiates the key update.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_INVALID_STATE`
+ *     The previous key update has not been confirmed yet; or key
+ *     update is too frequent; or new keys are not available yet; or
+ *     there are pending packets while a job detached by
+ *     `ngtcp2_conn_detach_protect_job` is outstanding.
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`
+ *     User-defined callback function failed while protecting the
+ *     pending packets (see `ngtcp2_conn_protect_pkts`).
+ */
+NGTCP2_EXTERN int ngtcp2_conn_initiate_key_update(ngtcp2_conn *conn,
+                                                  ngtcp2_tstamp ts);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_set_tls_error` sets the TLS related error |liberr| in
+ * |conn|.  |liberr| must be one of ngtcp2 library error codes (which
+ * is defined as NGTCP2_ERR_* macro, such as
+ * :macro:`NGTCP2_ERR_DECRYPT`).  In general, error code should be
+ * propagated via return value, but sometimes ngtcp2 API is called
+ * inside callback function of TLS stack and it does not allow to
+ * return ngtcp2 error code directly.  In this case, implementation
+ * can set the error code (e.g.,
+ * :macro:`NGTCP2_ERR_MALFORMED_TRANSPORT_PARAM`) using this function.
+ */
+NGTCP2_EXTERN void ngtcp2_conn_set_tls_error(ngtcp2_conn *conn, int liberr);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_get_tls_error` returns the value set by
+ * `ngtcp2_conn_set_tls_error`.  If no value is set, this function
+ * returns 0.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_get_tls_error(ngtcp2_conn *conn);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_set_tls_alert` sets a TLS alert |alert| generated by a
+ * local endpoint to |conn|.
+ */
+NGTCP2_EXTERN void ngtcp2_conn_set_tls_alert(ngtcp2_conn *conn, uint8_t alert);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_get_tls_alert` returns the value set by
+ * `ngtcp2_conn_set_tls_alert`.  If no value is set, this function
+ * returns 0.
+ */
+NGTCP2_EXTERN uint8_t ngtcp2_conn_get_tls_alert(ngtcp2_conn *conn);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_set_keep_alive_timeout` sets keep-alive timeout.  If
+ * nonzero value is given, after a connection is idle at least in a
+ * given amount of time, a keep-alive packet is sent.  If 0 is set,
+ * keep-alive functionality is disabled and this is the default.
+ */
+NGTCP2_EXTERN void ngtcp2_conn_set_keep_alive_timeout(ngtcp2_conn *conn,
+                                                      ngtcp2_duration timeout);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_set_keep_alive_external` tells |conn| whether the
+ * application schedules keep-alive by itself.  If |external| is
+ * nonzero, the keep-alive timer set by
+ * `ngtcp2_conn_set_keep_alive_timeout` is not included in
+ * `ngtcp2_conn_get_expiry`.  Instead, the application checks
+ * `ngtcp2_conn_get_keep_alive_expiry`, and sends a keep-alive packet
+ * by `ngtcp2_conn_write_keep_alive`.  This allows a server which has
+ * a large number of idle connections to ping them in batch rather
+ * than arming a timer for each connection.  A packet written by
+ * `ngtcp2_conn_writev_stream` still carries PING when the keep-alive
+ * timer has expired.
+ */
+NGTCP2_EXTERN void ngtcp2_conn_set_keep_alive_external(ngtcp2_conn *conn,
+                                                       int external);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_get_keep_alive_expiry` returns the time when the
+ * keep-alive timer expires, that is, the time when |conn| has been
+ * idle for the keep-alive timeout.  It returns ``UINT64_MAX`` if
+ * keep-alive is disabled.  Unlike `ngtcp2_conn_get_expiry`, the
+ * return value does not depend on
+ * `ngtcp2_conn_set_keep_alive_external`.
+ */
+NGTCP2_EXTERN ngtcp2_tstamp
+ngtcp2_conn_get_keep_alive_expiry(ngtcp2_conn *conn);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_write_keep_alive` writes a 1RTT packet which only
+ * contains PING frame in the buffer pointed by |dest| of length
+ * |destlen|.  It does not check whether the keep-alive timer has
+ * expired, so that the application can ping a connection a little
+ * early to align it to its batch window.  The packet is built
+ * without looking at the stream and the other pending frames, and it
+ * is not paced.
+ *
+ * |path| and |pi| are treated as in `ngtcp2_conn_writev_stream`.
+ *
+ * This function returns the number of bytes written in |dest| if it
+ * succeeds, 0 if the buffer is too small, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory
+ * :macro:`NGTCP2_ERR_INVALID_STATE`
+ *     Handshake has not completed; or the connection is closing or
+ *     draining; or a packet written with
+ *     :macro:`NGTCP2_WRITE_STREAM_FLAG_MORE` is pending.
+ * :macro:`NGTCP2_ERR_PKT_NUM_EXHAUSTED`
+ *     Packet number is exhausted, and cannot send any more packet.
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`
+ *     User callback failed
+ */
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_conn_write_keep_alive_versioned(
+    ngtcp2_conn *conn, ngtcp2_path *path, int pkt_info_version,
+    ngtcp2_pkt_info *pi, uint8_t *dest, size_t destlen, ngtcp2_tstamp ts);
+
 /**
  * @function
  *
- * `ngtcp2_pkt_write_connection_close` writes Initial packet
- * containing CONNECTION_CLOSE frame with the given |error_code| and
- * the optional |reason| of length |reasonlen| to the buffer pointed
- * by |dest| of length |destlen|.  All encryption parameters are for
- * Initial packet encryption.  The packet number is always 0.
+ * `ngtcp2_conn_get_expiry` returns the next expiry time.
  *
- * The primary use case of this function is for server to send
- * CONNECTION_CLOSE frame in Initial packet to close connection
- * without committing the state when validating Retry token fails.
+ * Call `ngtcp2_conn_handle_expiry()` and `ngtcp2_conn_write_pkt` (or
+ * `ngtcp2_conn_writev_stream`) if expiry time is passed.
+ */
+NGTCP2_EXTERN ngtcp2_tstamp ngtcp2_conn_get_expiry(ngtcp2_conn *conn);
+
+/**
+ * @function
  *
- * This function returns the number of bytes written if it succeeds,
- * or one of the following negative error codes:
+ * `ngtcp2_conn_handle_expiry` handles expired timer.  It does nothing
+ * if timer is not expired.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_handle_expiry(ngtcp2_conn *conn,
+                                            ngtcp2_tstamp ts);
+
+/**
+ * @function
  *
- * :macro:`NGTCP2_ERR_NOBUF`
- *     Buffer is too small.
+ * `ngtcp2_conn_get_pto` returns Probe Timeout (PTO).
+ */
+NGTCP2_EXTERN ngtcp2_duration ngtcp2_conn_get_pto(ngtcp2_conn *conn);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_decode_remote_transport_params` decodes QUIC transport
+ * parameters from the buffer pointed by |data| of length |datalen|,
+ * and sets the result to |conn|.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_REQUIRED_TRANSPORT_PARAM`
+ *     The required parameter is missing.
+ * :macro:`NGTCP2_ERR_MALFORMED_TRANSPORT_PARAM`
+ *     The input is malformed.
+ * :macro:`NGTCP2_ERR_TRANSPORT_PARAM`
+ *     Failed to validate the remote QUIC transport parameters.
+ * :macro:`NGTCP2_ERR_VERSION_NEGOTIATION_FAILURE`
+ *     Version negotiation failure.
  * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`
- *     Callback function failed.
+ *     User callback failed
  */
-NGTCP2_EXTERN ngtcp2_ssize ngtcp2_pkt_write_connection_close(
-    uint8_t *dest, size_t destlen, uint32_t version, const ngtcp2_cid *dcid,
-    const ngtcp2_cid *scid, uint64_t error_code, const uint8_t *reason,
-    size_t reasonlen, ngtcp2_encrypt encrypt, const ngtcp2_crypto_aead *aead,
-    const ngtcp2_crypto_aead_ctx *aead_ctx, const uint8_t *iv,
-    ngtcp2_hp_mask hp_mask, const ngtcp2_crypto_cipher *hp,
-    const ngtcp2_crypto_cipher_ctx *hp_ctx);
+NGTCP2_EXTERN int
+ngtcp2_conn_decode_remote_transport_params(ngtcp2_conn *conn,
+                                           const uint8_t *data, size_t datalen);
 
 /**
  * @function
  *
- * `ngtcp2_pkt_write_retry` writes Retry packet in the buffer pointed
- * by |dest| whose length is |destlen|.  |dcid| is the destination
- * connection ID which appeared in a packet as a source connection ID
- * sent by client.  |scid| is a server chosen source connection ID.
- * |odcid| specifies Original Destination Connection ID which appeared
- * in a packet as a destination connection ID sent by client.  |token|
- * specifies Retry Token, and |tokenlen| specifies its length.  |aead|
- * must be AEAD_AES_128_GCM.  |aead_ctx| must be initialized with
- * :macro:`NGTCP2_RETRY_KEY` as an encryption key.
+ * `ngtcp2_conn_get_remote_transport_params` returns a pointer to the
+ * remote QUIC transport parameters.  If no remote transport
+ * parameters are set, it returns NULL.
+ */
+NGTCP2_EXTERN const ngtcp2_transport_params *
+ngtcp2_conn_get_remote_transport_params(ngtcp2_conn *conn);
+
+/**
+ * @function
  *
- * This function returns the number of bytes written to the buffer, or
- * one of the following negative error codes:
+ * `ngtcp2_conn_set_early_remote_transport_params` sets |params| as
+ * transport parameters previously received from a server.  The
+ * parameters are used to send early data.  QUIC requires that client
+ * application should remember transport parameters along with a
+ * session ticket.
+ *
+ * At least following fields should be set:
+ *
+ * - initial_max_stream_id_bidi
+ * - initial_max_stream_id_uni
+ * - initial_max_stream_data_bidi_local
+ * - initial_max_stream_data_bidi_remote
+ * - initial_max_stream_data_uni
+ * - initial_max_data
+ * - active_connection_id_limit
+ * - max_datagram_frame_size (if DATAGRAM extension was negotiated)
+ *
+ * The following fields are ignored:
+ *
+ * - ack_delay_exponent
+ * - max_ack_delay
+ * - initial_scid
+ * - original_dcid
+ * - preferred_address and preferred_address_present
+ * - retry_scid and retry_scid_present
+ * - stateless_reset_token and stateless_reset_token_present
+ */
+NGTCP2_EXTERN void ngtcp2_conn_set_early_remote_transport_params_versioned(
+    ngtcp2_conn *conn, int transport_params_version,
+    const ngtcp2_transport_params *params);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_set_local_transport_params` sets the local transport
+ * parameters |params|.  This function can only be called by server.
+ * Although the local transport parameters are passed to
+ * `ngtcp2_conn_server_new`, server might want to update them after
+ * ALPN is chosen.  In that case, server can update the transport
+ * parameter with this function.  Server must call this function
+ * before calling `ngtcp2_conn_install_tx_handshake_key`.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_INVALID_STATE`
+ *     `ngtcp2_conn_install_tx_handshake_key` has been called.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_set_local_transport_params_versioned(
+    ngtcp2_conn *conn, int transport_params_version,
+    const ngtcp2_transport_params *params);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_get_local_transport_params` returns a pointer to the
+ * local QUIC transport parameters.
+ */
+NGTCP2_EXTERN const ngtcp2_transport_params *
+ngtcp2_conn_get_local_transport_params(ngtcp2_conn *conn);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_encode_local_transport_params` encodes the local QUIC
+ * transport parameters in |dest| of length |destlen|.  This is
+ * equivalent to calling `ngtcp2_conn_get_local_transport_params` and
+ * then `ngtcp2_encode_transport_params`.
+ *
+ * If :member:`ngtcp2_settings.transport_params_template` is set,
+ * server copies the connection independent part of the transport
+ * parameters from it.
+ *
+ * This function returns the number of written, or one of the
+ * following negative error codes:
  *
  * :macro:`NGTCP2_ERR_NOBUF`
  *     Buffer is too small.
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`
- *     Callback function failed.
- * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
- *     :member:`odcid->datalen <ngtcp2_cid.datalen>` is less than
- *     :macro:`NGTCP2_MIN_INITIAL_DCIDLEN`.
  */
-NGTCP2_EXTERN ngtcp2_ssize ngtcp2_pkt_write_retry(
-    uint8_t *dest, size_t destlen, uint32_t version, const ngtcp2_cid *dcid,
-    const ngtcp2_cid *scid, const ngtcp2_cid *odcid, const uint8_t *token,
-    size_t tokenlen, ngtcp2_encrypt encrypt, const ngtcp2_crypto_aead *aead,
-    const ngtcp2_crypto_aead_ctx *aead_ctx);
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_conn_encode_local_transport_params(
+    ngtcp2_conn *conn, uint8_t *dest, size_t destlen);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_open_bidi_stream` opens new bidirectional stream.  The
+ * |stream_user_data| is the user data specific to the stream.  The
+ * open stream ID is stored in |*pstream_id|.
+ *
+ * Application can call this function before handshake completes.  For
+ * 0RTT packet, application can call this function after calling
+ * `ngtcp2_conn_set_early_remote_transport_params`.  For 1RTT packet,
+ * application can call this function after calling
+ * `ngtcp2_conn_decode_remote_transport_params` and
+ * `ngtcp2_conn_install_tx_key`.  If ngtcp2 crypto support library is
+ * used, application can call this function after calling
+ * `ngtcp2_crypto_derive_and_install_tx_key` for 1RTT packet.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory
+ * :macro:`NGTCP2_ERR_STREAM_ID_BLOCKED`
+ *     The remote peer does not allow |stream_id| yet.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_open_bidi_stream(ngtcp2_conn *conn,
+                                               int64_t *pstream_id,
+                                               void *stream_user_data);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_open_uni_stream` opens new unidirectional stream.  The
+ * |stream_user_data| is the user data specific to the stream.  The
+ * open stream ID is stored in |*pstream_id|.
+ *
+ * Application can call this function before handshake completes.  For
+ * 0RTT packet, application can call this function after calling
+ * `ngtcp2_conn_set_early_remote_transport_params`.  For 1RTT packet,
+ * application can call this function after calling
+ * `ngtcp2_conn_decode_remote_transport_params` and
+ * `ngtcp2_conn_install_tx_key`.  If ngtcp2 crypto support library is
+ * used, application can call this function after calling
+ * `ngtcp2_crypto_derive_and_install_tx_key` for 1RTT packet.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory
+ * :macro:`NGTCP2_ERR_STREAM_ID_BLOCKED`
+ *     The remote peer does not allow |stream_id| yet.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_open_uni_stream(ngtcp2_conn *conn,
+                                              int64_t *pstream_id,
+                                              void *stream_user_data);
+
+/**
+ * @function
+ *
+ * `ngtcp2_conn_shutdown_stream` closes stream denoted by |stream_id|
+ * abruptly.  |app_error_code| is one of application error codes, and
+ * indicates the reason of shutdown.  Successful call of this function
+ * does not immediately erase the state of the stream.  The actual
+ * deletion is done when the remote endpoint sends acknowledgement.
+ * Calling this function is equivalent to call
+ * `ngtcp2_conn_shutdown_stream_read`, and
+ * `ngtcp2_conn_shutdown_stream_write` sequentially.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory
+ */
+NGTCP2_EXTERN int ngtcp2_conn_shutdown_stream(ngtcp2_conn *conn,
+                                              int64_t stream_id,
+                                              uint64_t app_error_code);
 
 /**
  * @function
  *
- * `ngtcp2_accept` is used by server implementation, and decides
- * whether packet |pkt| of length |pktlen| from client is acceptable
- * for the very initial packet to a connection.
- *
- * If |dest| is not ``NULL`` and the function returns 0, or
- * :macro:`NGTCP2_ERR_RETRY`, the decoded packet header is stored to
- * the object pointed by |dest|.
+ * `ngtcp2_conn_shutdown_stream_write` closes write-side of stream
+ * denoted by |stream_id| abruptly.  |app_error_code| is one of
+ * application error codes, and indicates the reason of shutdown.  If
+ * this function succeeds, no application data is sent to the remote
+ * endpoint.  It discards all data which has not been acknowledged
+ * yet.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
  *
- * :macro:`NGTCP2_ERR_RETRY`
- *     Retry packet should be sent.
- * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
- *     The packet is not acceptable for the very first packet to a new
- *     connection; or the function failed to parse the packet header.
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory
  */
-NGTCP2_EXTERN int ngtcp2_accept(ngtcp2_pkt_hd *dest, const uint8_t *pkt,
-                                size_t pktlen);
+NGTCP2_EXTERN int ngtcp2_conn_shutdown_stream_write(ngtcp2_conn *conn,
+                                                    int64_t stream_id,
+                                                    uint64_t app_error_code);
 
 /**
  * @function
  *
- * `ngtcp2_conn_client_new` creates new :type:`ngtcp2_conn`, and
- * initializes it as client.  |dcid| is randomized destination
- * connection ID.  |scid| is source connection ID.
- * |client_chosen_version| is a QUIC version that a client chooses.
- * |path| is the network path where this QUIC connection is being
- * established and must not be ``NULL``.  |callbacks|, |settings|, and
- * |params| must not be ``NULL``, and the function make a copy of each
- * of them.  |params| is local QUIC transport parameters and sent to a
- * remote endpoint during handshake.  |user_data| is the arbitrary
- * pointer which is passed to the user-defined callback functions.  If
- * |mem| is ``NULL``, the memory allocator returned by
- * `ngtcp2_mem_default()` is used.
+ * `ngtcp2_conn_shutdown_stream_read` closes read-side of stream
+ * denoted by |stream_id| abruptly.  |app_error_code| is one of
+ * application error codes, and indicates the reason of shutdown.  If
+ * this function succeeds, no application data is forwarded to an
+ * application layer.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
  *
  * :macro:`NGTCP2_ERR_NOMEM`
- *     Out of memory.
+ *     Out of memory
  */
-NGTCP2_EXTERN int ngtcp2_conn_client_new_versioned(
-    ngtcp2_conn **pconn, const ngtcp2_cid *dcid, const ngtcp2_cid *scid,
-    const ngtcp2_path *path, uint32_t client_chosen_version,
-    int callbacks_version, const ngtcp2_callbacks *callbacks,
-    int settings_version, const ngtcp2_settings *settings,
-    int transport_params_version, const ngtcp2_transport_params *params,
-    const ngtcp2_mem *mem, void *user_data);
+NGTCP2_EXTERN int ngtcp2_conn_shutdown_stream_read(ngtcp2_conn *conn,
+                                                   int64_t stream_id,
+                                                   uint64_t app_error_code);
+
+/**
+ * @macrosection
+ *
+ * Write stream data flags
+ */
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_WRITE_STREAM_FLAG_NONE` indicates no flag set.
+ */
+#define NGTCP2_WRITE_STREAM_FLAG_NONE 0x00u
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_WRITE_STREAM_FLAG_MORE` indicates that more data may
+ * come and should be coalesced into the same packet if possible.
+ */
+#define NGTCP2_WRITE_STREAM_FLAG_MORE 0x01u
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_WRITE_STREAM_FLAG_FIN` indicates that the passed
+ * data is the final part of a stream.
+ */
+#define NGTCP2_WRITE_STREAM_FLAG_FIN 0x02u
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_WRITE_STREAM_FLAG_PADDING` makes the library pad a
+ * non-empty 1RTT packet to the full length of the given buffer.  It
+ * takes effect when a packet is started, that is, on the first call
+ * of the sequence of calls with
+ * :macro:`NGTCP2_WRITE_STREAM_FLAG_MORE` which build the same
+ * packet.
+ */
+#define NGTCP2_WRITE_STREAM_FLAG_PADDING 0x04u
 
 /**
  * @function
  *
- * `ngtcp2_conn_server_new` creates new :type:`ngtcp2_conn`, and
- * initializes it as server.  |dcid| is a destination connection ID.
- * |scid| is a source connection ID.  |path| is the network path where
- * this QUIC connection is being established and must not be ``NULL``.
- * |client_chosen_version| is a QUIC version that a client chooses.
- * |callbacks|, |settings|, and |params| must not be ``NULL``, and the
- * function make a copy of each of them.  |params| is local QUIC
- * transport parameters and sent to a remote endpoint during
- * handshake.  |user_data| is the arbitrary pointer which is passed to
- * the user-defined callback functions.  If |mem| is ``NULL``, the
- * memory allocator returned by `ngtcp2_mem_default()` is used.
+ * `ngtcp2_conn_write_stream` is just like
+ * `ngtcp2_conn_writev_stream`.  The only difference is that it
+ * conveniently accepts a single buffer.
+ */
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_conn_write_stream_versioned(
+    ngtcp2_conn *conn, ngtcp2_path *path, int pkt_info_version,
+    ngtcp2_pkt_info *pi, uint8_t *dest, size_t destlen, ngtcp2_ssize *pdatalen,
+    uint32_t flags, int64_t stream_id, const uint8_t *data, size_t datalen,
+    ngtcp2_tstamp ts);
+
+/**
+ * @function
  *
- * This function returns 0 if it succeeds, or one of the following
- * negative error codes:
+ * `ngtcp2_conn_writev_stream` writes a packet containing stream data
+ * of stream denoted by |stream_id|.  The buffer of the packet is
+ * pointed by |dest| of length |destlen|.  This function performs QUIC
+ * handshake as well.
+ *
+ * |destlen| should be at least
+ * :member:`ngtcp2_settings.max_udp_payload_size`.
+ *
+ * Specifying -1 to |stream_id| means no new stream data to send.
+ *
+ * If |path| is not ``NULL``, this function stores the network path
+ * with which the packet should be sent.  Each addr field must point
+ * to the buffer which should be at least ``sizeof(struct
+ * sockaddr_storage)`` bytes long.  The assignment might not be done
+ * if nothing is written to |dest|.
+ *
+ * If |pi| is not ``NULL``, this function stores packet metadata in it
+ * if it succeeds.  The metadata includes ECN markings.  When calling
+ * this function again after it returns
+ * :macro:`NGTCP2_ERR_WRITE_MORE`, caller must pass the same |pi| to
+ * this function.
+ *
+ * If the all given data is encoded as STREAM frame in |dest|, and if
+ * |flags| & :macro:`NGTCP2_WRITE_STREAM_FLAG_FIN` is nonzero, fin
+ * flag is set to outgoing STREAM frame.  Otherwise, fin flag in
+ * STREAM frame is not set.
+ *
+ * This packet may contain frames other than STREAM frame.  The packet
+ * might not contain STREAM frame if other frames occupy the packet.
+ * In that case, |*pdatalen| would be -1 if |pdatalen| is not
+ * ``NULL``.
+ *
+ * If |flags| & :macro:`NGTCP2_WRITE_STREAM_FLAG_FIN` is nonzero, and
+ * 0 length STREAM frame is successfully serialized, |*pdatalen| would
+ * be 0.
+ *
+ * The number of data encoded in STREAM frame is stored in |*pdatalen|
+ * if it is not ``NULL``.  The caller must keep the portion of data
+ * covered by |*pdatalen| bytes in tact until
+ * :type:`ngtcp2_acked_stream_data_offset` indicates that they are
+ * acknowledged by a remote endpoint or the stream is closed.
+ *
+ * If |flags| equals to :macro:`NGTCP2_WRITE_STREAM_FLAG_NONE`, this
+ * function produces a single payload of UDP packet.  If the given
+ * stream data is small (e.g., few bytes), the packet might be
+ * severely under filled.  Too many small packet might increase
+ * overall packet processing costs.  Unless there are retransmissions,
+ * by default, application can only send 1 STREAM frame in one QUIC
+ * packet.  In order to include more than 1 STREAM frame in one QUIC
+ * packet, specify :macro:`NGTCP2_WRITE_STREAM_FLAG_MORE` in |flags|.
+ * This is analogous to ``MSG_MORE`` flag in :manpage:`send(2)`.  If
+ * the :macro:`NGTCP2_WRITE_STREAM_FLAG_MORE` is used, there are 4
+ * outcomes:
+ *
+ * - The function returns the written length of packet just like
+ *   without :macro:`NGTCP2_WRITE_STREAM_FLAG_MORE`.  This is because
+ *   packet is nearly full and the library decided to make a complete
+ *   packet.  |*pdatalen| might be -1 or >= 0.
+ *
+ * - The function returns :macro:`NGTCP2_ERR_WRITE_MORE`.  In this
+ *   case, |*pdatalen| >= 0 is asserted.  This indicates that
+ *   application can call this function with different stream data (or
+ *   `ngtcp2_conn_writev_datagram` if it has data to send in
+ *   unreliable datagram) to pack them into the same packet.
+ *   Application has to specify the same |conn|, |path|, |pi|, |dest|,
+ *   |destlen|, and |ts| parameters, otherwise the behaviour is
+ *   undefined.  The application can change |flags|.
+ *
+ * - The function returns :macro:`NGTCP2_ERR_STREAM_DATA_BLOCKED` which
+ *   indicates that stream is blocked because of flow control.
+ *
+ * - The other error might be returned just like without
+ *   :macro:`NGTCP2_WRITE_STREAM_FLAG_MORE`.
+ *
+ * When application sees :macro:`NGTCP2_ERR_WRITE_MORE`, it must not
+ * call other ngtcp2 API functions (application can still call
+ * `ngtcp2_conn_write_connection_close` to handle error from this
+ * function).  Just keep calling `ngtcp2_conn_writev_stream`,
+ * `ngtcp2_conn_write_pkt`, or `ngtcp2_conn_writev_datagram` until it
+ * returns a positive number (which indicates a complete packet is
+ * ready).  If there is no stream data to include, call this function
+ * with |stream_id| as -1 to stop coalescing and write a packet.
+ *
+ * This function returns 0 if it cannot write any frame because buffer
+ * is too small, or packet is congestion limited.  Application should
+ * keep reading and wait for congestion window to grow.
+ *
+ * This function must not be called from inside the callback
+ * functions.
+ *
+ * If pacing is enabled, `ngtcp2_conn_update_pkt_tx_time` must be
+ * called after this function.  Application may call this function
+ * multiple times before calling `ngtcp2_conn_update_pkt_tx_time`.
+ * Packet pacing is enabled if BBR congestion controller algorithm is
+ * used.
+ *
+ * This function returns the number of bytes written in |dest| if it
+ * succeeds, or one of the following negative error codes:
  *
  * :macro:`NGTCP2_ERR_NOMEM`
- *     Out of memory.
+ *     Out of memory
+ * :macro:`NGTCP2_ERR_STREAM_NOT_FOUND`
+ *     Stream does not exist
+ * :macro:`NGTCP2_ERR_STREAM_SHUT_WR`
+ *     Stream is half closed (local); or stream is being reset.
+ * :macro:`NGTCP2_ERR_PKT_NUM_EXHAUSTED`
+ *     Packet number is exhausted, and cannot send any more packet.
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`
+ *     User callback failed
+ * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     The total length of stream data is too large; or the stream
+ *     data are given to a stream which has the send buffer set by
+ *     `ngtcp2_conn_set_stream_sendbuf`.
+ * :macro:`NGTCP2_ERR_STREAM_DATA_BLOCKED`
+ *     Stream is blocked because of flow control.
+ * :macro:`NGTCP2_ERR_WRITE_MORE`
+ *     (Only when :macro:`NGTCP2_WRITE_STREAM_FLAG_MORE` is specified)
+ *     Application can call this function to pack more stream data
+ *     into the same packet.  See above to know how it works.
+ *
+ * In general, if the error code which satisfies
+ * `ngtcp2_err_is_fatal(err) <ngtcp2_err_is_fatal>` != 0 is returned,
+ * the application should just close the connection by calling
+ * `ngtcp2_conn_write_connection_close` or just delete the QUIC
+ * connection using `ngtcp2_conn_del`.  It is undefined to call the
+ * other library functions.
  */
-NGTCP2_EXTERN int ngtcp2_conn_server_new_versioned(
-    ngtcp2_conn **pconn, const ngtcp2_cid *dcid, const ngtcp2_cid *scid,
-    const ngtcp2_path *path, uint32_t client_chosen_version,
-    int callbacks_version, const ngtcp2_callbacks *callbacks,
-    int settings_version, const ngtcp2_settings *settings,
-    int transport_params_version, const ngtcp2_transport_params *params,
-    const ngtcp2_mem *mem, void *user_data);
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_conn_writev_stream_versioned(
+    ngtcp2_conn *conn, ngtcp2_path *path, int pkt_info_version,
+    ngtcp2_pkt_info *pi, uint8_t *dest, size_t destlen, ngtcp2_ssize *pdatalen,
+    uint32_t flags, int64_t stream_id, const ngtcp2_vec *datav, size_t datavcnt,
+    ngtcp2_tstamp ts);
 
 /**
- * @function
+ * @struct
  *
- * `ngtcp2_conn_del` frees resources allocated for |conn|.  It also
- * frees memory pointed by |conn|.
+ * :type:`ngtcp2_stream_write` is the stream data to send by
+ * `ngtcp2_conn_writev_streams`.
  */
-NGTCP2_EXTERN void ngtcp2_conn_del(ngtcp2_conn *conn);
+typedef struct ngtcp2_stream_write {
+  /**
+   * :member:`stream_id` is the stream ID of a stream to send data.
+   */
+  int64_t stream_id;
+  /**
+   * :member:`flags` is zero or
+   * :macro:`NGTCP2_WRITE_STREAM_FLAG_FIN`, which makes the last byte
+   * of :member:`datav` the final byte of the stream.
+   */
+  uint32_t flags;
+  /**
+   * :member:`datav` is the stream data to send.
+   */
+  const ngtcp2_vec *datav;
+  /**
+   * :member:`datavcnt` is the number of elements in :member:`datav`.
+   */
+  size_t datavcnt;
+  /**
+   * :member:`ndatalen` is set by `ngtcp2_conn_writev_streams` to the
+   * number of bytes of :member:`datav` which are sent.
+   */
+  uint64_t ndatalen;
+} ngtcp2_stream_write;
 
 /**
  * @function
  *
- * `ngtcp2_conn_read_pkt` decrypts QUIC packet given in |pkt| of
- * length |pktlen| and processes it.  |path| is the network path the
- * packet is delivered and must not be ``NULL``.  |pi| is packet
- * metadata and may be ``NULL``. This function performs QUIC handshake
- * as well.
- *
- * This function must not be called from inside the callback
- * functions.
- *
- * This function returns 0 if it succeeds, or negative error codes.
- * If :macro:`NGTCP2_ERR_RETRY` is returned, application must be a
- * server and it must perform address validation by sending Retry
- * packet and discard the connection state.  If
- * :macro:`NGTCP2_ERR_DROP_CONN` is returned, server application must
- * drop the connection silently (without sending any CONNECTION_CLOSE
- * frame) and discard connection state.  If
- * :macro:`NGTCP2_ERR_DRAINING` is returned, a connection has entered
- * the draining state, and no further packet transmission is allowed.
- * If :macro:`NGTCP2_ERR_CRYPTO` is returned, the error happened in
- * TLS stack and `ngtcp2_conn_get_tls_alert` returns TLS alert if set.
- *
- * If any other negative errors are returned, call
- * `ngtcp2_conn_write_connection_close` to get terminal packet, and
- * sending it makes QUIC connection enter the closing state.
- */
-NGTCP2_EXTERN int
-ngtcp2_conn_read_pkt_versioned(ngtcp2_conn *conn, const ngtcp2_path *path,
-                               int pkt_info_version, const ngtcp2_pkt_info *pi,
-                               const uint8_t *pkt, size_t pktlen,
-                               ngtcp2_tstamp ts);
+ * `ngtcp2_conn_writev_streams` writes one or more packets containing
+ * the data of the streams in |sw| of length |swcnt| back to back in
+ * the buffer pointed by |dest| of length |destlen|.  It is equivalent
+ * to calling `ngtcp2_conn_writev_stream` with
+ * :macro:`NGTCP2_WRITE_STREAM_FLAG_MORE` for each element of |sw| in
+ * order, moving to the next element when the stream has sent all of
+ * its data, or it is blocked or shut down, and finishing a packet with
+ * |stream_id| -1 when no element is left.
+ *
+ * The packets are written until |destlen|, or the send quantum
+ * returned by `ngtcp2_conn_get_send_quantum` is used up.  All packets
+ * have the same length which is assigned to |*pgsolen|, except that
+ * the last one might be shorter, so that they can be sent with UDP
+ * GSO.  All packets are sent to the same |path| with the same |pi|,
+ * which are set to those of the first packet.  The function writes a
+ * single packet while the path validation or the ECN validation is
+ * in progress.
+ *
+ * :member:`ngtcp2_stream_write.ndatalen` of each element is set to
+ * the number of bytes sent which might be less than the length of
+ * :member:`ngtcp2_stream_write.datav`.
+ *
+ * This function returns the number of bytes written in |dest|, which
+ * might be 0, if it succeeds, or one of the negative error codes that
+ * `ngtcp2_conn_writev_stream` returns except for
+ * :macro:`NGTCP2_ERR_STREAM_NOT_FOUND`,
+ * :macro:`NGTCP2_ERR_STREAM_SHUT_WR`,
+ * :macro:`NGTCP2_ERR_STREAM_DATA_BLOCKED`, and
+ * :macro:`NGTCP2_ERR_WRITE_MORE`.  If it fails, the packets written
+ * in |dest| so far must be discarded.
+ */
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_conn_writev_streams_versioned(
+    ngtcp2_conn *conn, ngtcp2_path *path, int pkt_info_version,
+    ngtcp2_pkt_info *pi, uint8_t *dest, size_t destlen, size_t *pgsolen,
+    ngtcp2_stream_write *sw, size_t swcnt, ngtcp2_tstamp ts);
 
 /**
  * @function
  *
- * `ngtcp2_conn_write_pkt` is equivalent to calling
- * `ngtcp2_conn_writev_stream` with -1 as stream_id, no stream data, and
- * :macro:`NGTCP2_WRITE_STREAM_FLAG_NONE` as flags.
- */
-NGTCP2_EXTERN ngtcp2_ssize ngtcp2_conn_write_pkt_versioned(
+ * `ngtcp2_conn_write_burst` is just like `ngtcp2_conn_writev_streams`,
+ * but it plans the packets for UDP GSO.  It writes at most |max_pkts|
+ * packets, and all of them except for the last one have the length of
+ * the maximum UDP payload size of the current path, which is assigned
+ * to |*pgsolen|.  A packet which would be shorter is padded while the
+ * elements of |sw| still have data to send, so that a short packet,
+ * like the one which only carries ACK frame, does not cut the batch
+ * short.  The last packet might be shorter than |*pgsolen|.  The
+ * application can pass the returned buffer to a single
+ * ``sendmsg(2)`` with ``UDP_SEGMENT`` set to |*pgsolen|.
+ *
+ * If |max_pkts| is 0, the number of packets is only limited by
+ * |destlen| and the send quantum.
+ *
+ * This function returns the number of bytes written in |dest|, which
+ * might be 0, if it succeeds, or one of the negative error codes that
+ * `ngtcp2_conn_writev_streams` returns.  If it fails, the packets
+ * written in |dest| so far must be discarded.
+ */
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_conn_write_burst_versioned(
     ngtcp2_conn *conn, ngtcp2_path *path, int pkt_info_version,
-    ngtcp2_pkt_info *pi, uint8_t *dest, size_t destlen, ngtcp2_tstamp ts);
+    ngtcp2_pkt_info *pi, uint8_t *dest, size_t destlen, size_t max_pkts,
+    size_t *pgsolen, ngtcp2_stream_write *sw, size_t swcnt, ngtcp2_tstamp ts);
 
 /**
- * @function
+ * @macrosection
  *
- * `ngtcp2_conn_handshake_completed` tells |conn| that the TLS stack
- * declares TLS handshake completion.  This does not mean QUIC
- * handshake has completed.  The library needs extra conditions to be
- * met.
+ * Write datagram flags
  */
-NGTCP2_EXTERN void ngtcp2_conn_handshake_completed(ngtcp2_conn *conn);
 
 /**
- * @function
+ * @macro
  *
- * `ngtcp2_conn_get_handshake_completed` returns nonzero if QUIC handshake
- * has completed.
+ * :macro:`NGTCP2_WRITE_DATAGRAM_FLAG_NONE` indicates no flag set.
  */
-NGTCP2_EXTERN int ngtcp2_conn_get_handshake_completed(ngtcp2_conn *conn);
+#define NGTCP2_WRITE_DATAGRAM_FLAG_NONE 0x00u
 
 /**
- * @function
- *
- * `ngtcp2_conn_install_initial_key` installs packet protection keying
- * materials for Initial packets.  |rx_aead_ctx| is AEAD cipher
- * context object and must be initialized with a decryption key.
- * |rx_iv| is IV of length |rx_ivlen| for decryption.  |rx_hp_ctx| is
- * a packet header protection cipher context object for decryption.
- * Similarly, |tx_aead_ctx|, |tx_iv| and |tx_hp_ctx| are for
- * encrypting outgoing packets and are the same length with the
- * decryption counterpart .  If they have already been set, they are
- * overwritten.
- *
- * |ivlen| must be the minimum length of AEAD nonce, or 8 bytes if
- * that is larger.
- *
- * If this function succeeds, |conn| takes ownership of |rx_aead_ctx|,
- * |rx_hp_ctx|, |tx_aead_ctx|, and |tx_hp_ctx|.
- * :type:`ngtcp2_delete_crypto_aead_ctx` and
- * :type:`ngtcp2_delete_crypto_cipher_ctx` will be called to delete
- * these objects when they are no longer used.  If this function
- * fails, the caller is responsible to delete them.
- *
- * After receiving Retry packet, the DCID most likely changes.  In
- * that case, client application must generate these keying materials
- * again based on new DCID and install them again.
- *
- * This function returns 0 if it succeeds, or one of the following
- * negative error codes:
+ * @macro
  *
- * :macro:`NGTCP2_ERR_NOMEM`
- *     Out of memory.
+ * :macro:`NGTCP2_WRITE_DATAGRAM_FLAG_MORE` indicates that more data
+ * may come and should be coalesced into the same packet if possible.
  */
-NGTCP2_EXTERN int ngtcp2_conn_install_initial_key(
-    ngtcp2_conn *conn, const ngtcp2_crypto_aead_ctx *rx_aead_ctx,
-    const uint8_t *rx_iv, const ngtcp2_crypto_cipher_ctx *rx_hp_ctx,
-    const ngtcp2_crypto_aead_ctx *tx_aead_ctx, const uint8_t *tx_iv,
-    const ngtcp2_crypto_cipher_ctx *tx_hp_ctx, size_t ivlen);
+#define NGTCP2_WRITE_DATAGRAM_FLAG_MORE 0x01u
 
 /**
  * @function
  *
- * `ngtcp2_conn_install_vneg_initial_key` installs packet protection
- * keying materials for Initial packets on compatible version
- * negotiation for |version|.  |rx_aead_ctx| is AEAD cipher context
- * object and must be initialized with a decryption key.  |rx_iv| is
- * IV of length |rx_ivlen| for decryption.  |rx_hp_ctx| is a packet
- * header protection cipher context object for decryption.  Similarly,
- * |tx_aead_ctx|, |tx_iv| and |tx_hp_ctx| are for encrypting outgoing
- * packets and are the same length with the decryption counterpart .
- * If they have already been set, they are overwritten.
- *
- * |ivlen| must be the minimum length of AEAD nonce, or 8 bytes if
- * that is larger.
+ * `ngtcp2_conn_writev_datagram` writes a packet containing unreliable
+ * data in DATAGRAM frame.  The buffer of the packet is pointed by
+ * |dest| of length |destlen|.  This function performs QUIC handshake
+ * as well.
  *
- * If this function succeeds, |conn| takes ownership of |rx_aead_ctx|,
- * |rx_hp_ctx|, |tx_aead_ctx|, and |tx_hp_ctx|.
- * :type:`ngtcp2_delete_crypto_aead_ctx` and
- * :type:`ngtcp2_delete_crypto_cipher_ctx` will be called to delete
- * these objects when they are no longer used.  If this function
- * fails, the caller is responsible to delete them.
+ * |destlen| should be at least
+ * :member:`ngtcp2_settings.max_udp_payload_size`.
  *
- * This function returns 0 if it succeeds, or one of the following
- * negative error codes:
+ * For |path| and |pi| parameters, refer to
+ * `ngtcp2_conn_writev_stream`.
  *
- * :macro:`NGTCP2_ERR_NOMEM`
- *     Out of memory.
- */
-NGTCP2_EXTERN int ngtcp2_conn_install_vneg_initial_key(
-    ngtcp2_conn *conn, uint32_t version,
-    const ngtcp2_crypto_aead_ctx *rx_aead_ctx, const uint8_t *rx_iv,
-    const ngtcp2_crypto_cipher_ctx *rx_hp_ctx,
-    const ngtcp2_crypto_aead_ctx *tx_aead_ctx, const uint8_t *tx_iv,
-    const ngtcp2_crypto_cipher_ctx *tx_hp_ctx, size_t ivlen);
-
-/**
- * @function
+ * If the given data is written to the buffer, nonzero value is
+ * assigned to |*paccepted| if it is not NULL.  The data in DATAGRAM
+ * frame cannot be fragmented; writing partial data is not possible.
  *
- * `ngtcp2_conn_install_rx_handshake_key` installs packet protection
- * keying materials for decrypting incoming Handshake packets.
- * |aead_ctx| is AEAD cipher context object which must be initialized
- * with a decryption key.  |iv| is IV of length |ivlen|.  |hp_ctx| is
- * a packet header protection cipher context object.
+ * |dgram_id| is an opaque identifier which should uniquely identify
+ * the given DATAGRAM.  It is passed to :type:`ngtcp2_ack_datagram`
+ * callback when a packet that contains DATAGRAM frame is
+ * acknowledged.  It is passed to :type:`ngtcp2_lost_datagram`
+ * callback when a packet that contains DATAGRAM frame is declared
+ * lost.  If an application uses neither of those callbacks, it can
+ * sets 0 to this parameter.
  *
- * |ivlen| must be the minimum length of AEAD nonce, or 8 bytes if
- * that is larger.
+ * This function might write other frames other than DATAGRAM, just
+ * like `ngtcp2_conn_writev_stream`.
  *
- * If this function succeeds, |conn| takes ownership of |aead_ctx|,
- * and |hp_ctx|.  :type:`ngtcp2_delete_crypto_aead_ctx` and
- * :type:`ngtcp2_delete_crypto_cipher_ctx` will be called to delete
- * these objects when they are no longer used.  If this function
- * fails, the caller is responsible to delete them.
+ * If the function returns 0, it means that no more data cannot be
+ * sent because of congestion control limit; or, data does not fit
+ * into the provided buffer; or, a local endpoint, as a server, is
+ * unable to send data because of its amplification limit.  In this
+ * case, |*paccepted| is assigned zero if it is not NULL.
  *
- * This function returns 0 if it succeeds, or one of the following
- * negative error codes:
+ * If :macro:`NGTCP2_WRITE_DATAGRAM_FLAG_MORE` is set in |flags|,
+ * there are 3 outcomes:
  *
- * :macro:`NGTCP2_ERR_NOMEM`
- *     Out of memory.
- */
-NGTCP2_EXTERN int ngtcp2_conn_install_rx_handshake_key(
-    ngtcp2_conn *conn, const ngtcp2_crypto_aead_ctx *aead_ctx,
-    const uint8_t *iv, size_t ivlen, const ngtcp2_crypto_cipher_ctx *hp_ctx);
-
-/**
- * @function
+ * - The function returns the written length of packet just like
+ *   without :macro:`NGTCP2_WRITE_DATAGRAM_FLAG_MORE`.  This is
+ *   because packet is nearly full and the library decided to make a
+ *   complete packet.  |*paccepted| might be zero or nonzero.
  *
- * `ngtcp2_conn_install_tx_handshake_key` installs packet protection
- * keying materials for encrypting outgoing Handshake packets.
- * |aead_ctx| is AEAD cipher context object which must be initialized
- * with an encryption key.  |iv| is IV of length |ivlen|.  |hp_ctx| is
- * a packet header protection cipher context object.
+ * - The function returns :macro:`NGTCP2_ERR_WRITE_MORE`.  In this
+ *   case, |*paccepted| != 0 is asserted.  This indicates that
+ *   application can call this function with another unreliable data
+ *   (or `ngtcp2_conn_writev_stream` if it has stream data to send) to
+ *   pack them into the same packet.  Application has to specify the
+ *   same |conn|, |path|, |pi|, |dest|, |destlen|, and |ts|
+ *   parameters, otherwise the behaviour is undefined.  The
+ *   application can change |flags|.
  *
- * |ivlen| must be the minimum length of AEAD nonce, or 8 bytes if
- * that is larger.
+ * - The other error might be returned just like without
+ *   :macro:`NGTCP2_WRITE_DATAGRAM_FLAG_MORE`.
  *
- * If this function succeeds, |conn| takes ownership of |aead_ctx| and
- * |hp_ctx|.  :type:`ngtcp2_delete_crypto_aead_ctx` and
- * :type:`ngtcp2_delete_crypto_cipher_ctx` will be called to delete
- * these objects when they are no longer used.  If this function
- * fails, the caller is responsible to delete them.
+ * When application sees :macro:`NGTCP2_ERR_WRITE_MORE`, it must not
+ * call other ngtcp2 API functions (application can still call
+ * `ngtcp2_conn_write_connection_close` to handle error from this
+ * function).  Just keep calling `ngtcp2_conn_writev_datagram`,
+ * `ngtcp2_conn_writev_stream` or `ngtcp2_conn_write_pkt` until it
+ * returns a positive number (which indicates a complete packet is
+ * ready).
  *
- * This function returns 0 if it succeeds, or one of the following
- * negative error codes:
+ * This function returns the number of bytes written in |dest| if it
+ * succeeds, or one of the following negative error codes:
  *
  * :macro:`NGTCP2_ERR_NOMEM`
- *     Out of memory.
+ *     Out of memory
+ * :macro:`NGTCP2_ERR_PKT_NUM_EXHAUSTED`
+ *     Packet number is exhausted, and cannot send any more packet.
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`
+ *     User callback failed
+ * :macro:`NGTCP2_ERR_WRITE_MORE`
+ *     (Only when :macro:`NGTCP2_WRITE_DATAGRAM_FLAG_MORE` is
+ *     specified) Application can call this function to pack more data
+ *     into the same packet.  See above to know how it works.
+ * :macro:`NGTCP2_ERR_INVALID_STATE`
+ *     A remote endpoint did not express the DATAGRAM frame support.
+ * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     The provisional DATAGRAM frame size exceeds the maximum
+ *     DATAGRAM frame size that a remote endpoint can receive.
+ *
+ * In general, if the error code which satisfies
+ * `ngtcp2_err_is_fatal(err) <ngtcp2_err_is_fatal>` != 0 is returned,
+ * the application should just close the connection by calling
+ * `ngtcp2_conn_write_connection_close` or just delete the QUIC
+ * connection using `ngtcp2_conn_del`.  It is undefined to call the
+ * other library functions.
  */
-NGTCP2_EXTERN int ngtcp2_conn_install_tx_handshake_key(
-    ngtcp2_conn *conn, const ngtcp2_crypto_aead_ctx *aead_ctx,
-    const uint8_t *iv, size_t ivlen, const ngtcp2_crypto_cipher_ctx *hp_ctx);
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_conn_writev_datagram_versioned(
+    ngtcp2_conn *conn, ngtcp2_path *path, int pkt_info_version,
+    ngtcp2_pkt_info *pi, uint8_t *dest, size_t destlen, int *paccepted,
+    uint32_t flags, uint64_t dgram_id, const ngtcp2_vec *datav, size_t datavcnt,
+    ngtcp2_tstamp ts);
 
 /**
- * @function
- *
- * `ngtcp2_conn_install_early_key` installs packet protection AEAD
- * cipher context object |aead_ctx|, IV |iv| of length |ivlen|, and
- * packet header protection cipher context object |hp_ctx| to encrypt
- * (for client) or decrypt (for server) 0RTT packets.
- *
- * |ivlen| must be the minimum length of AEAD nonce, or 8 bytes if
- * that is larger.
+ * @function
  *
- * If this function succeeds, |conn| takes ownership of |aead_ctx| and
- * |hp_ctx|.  :type:`ngtcp2_delete_crypto_aead_ctx` and
- * :type:`ngtcp2_delete_crypto_cipher_ctx` will be called to delete
- * these objects when they are no longer used.  If this function
- * fails, the caller is responsible to delete them.
+ * `ngtcp2_conn_enqueue_datagram` queues unreliable data in DATAGRAM
+ * frame for later transmission.  Unlike
+ * `ngtcp2_conn_writev_datagram`, it does not write a packet.  The
+ * queued DATAGRAMs are packed, as many as they fit, into the 1RTT
+ * packets that `ngtcp2_conn_writev_stream`, `ngtcp2_conn_write_pkt`,
+ * or the other functions which write packets produce, ahead of
+ * stream data, in the order they are queued.
+ *
+ * The data pointed by |datav| of length |datavcnt| is not copied.
+ * The application must keep it alive until the DATAGRAM is written
+ * into a packet.  Because the application is told of it only through
+ * :type:`ngtcp2_ack_datagram` and :type:`ngtcp2_lost_datagram`
+ * callbacks with |dgram_id|, it should set them to know when to
+ * release the data, e.g., to drop a reference to a buffer shared by
+ * many connections.  The data which is still queued when |conn| is
+ * deleted by `ngtcp2_conn_del` is released without any callback.
+ *
+ * |expiry| is the deadline of the DATAGRAM.  If it is not sent by
+ * |expiry|, it is dropped, and :type:`ngtcp2_lost_datagram` is
+ * invoked for it.  Specify ``UINT64_MAX`` for no deadline.  A
+ * DATAGRAM which does not fit in a packet even if it is the only
+ * frame is dropped in the same way.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
  *
  * :macro:`NGTCP2_ERR_NOMEM`
- *     Out of memory.
+ *     Out of memory
+ * :macro:`NGTCP2_ERR_INVALID_STATE`
+ *     A remote endpoint did not express the DATAGRAM frame support.
+ * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     The provisional DATAGRAM frame size exceeds the maximum
+ *     DATAGRAM frame size that a remote endpoint can receive.
  */
-NGTCP2_EXTERN int ngtcp2_conn_install_early_key(
-    ngtcp2_conn *conn, const ngtcp2_crypto_aead_ctx *aead_ctx,
-    const uint8_t *iv, size_t ivlen, const ngtcp2_crypto_cipher_ctx *hp_ctx);
+NGTCP2_EXTERN int ngtcp2_conn_enqueue_datagram(ngtcp2_conn *conn,
+                                               uint64_t dgram_id,
+                                               const ngtcp2_vec *datav,
+                                               size_t datavcnt,
+                                               ngtcp2_tstamp expiry);
 
 /**
  * @function
  *
- * `ngtcp2_conn_install_rx_key` installs packet protection keying
- * materials for decrypting Short header packets.  |secret| of length
- * |secretlen| is the decryption secret which is used to derive keying
- * materials passed to this function.  |aead_ctx| is AEAD cipher
- * context object which must be initialized with a decryption key.
- * |iv| is IV of length |ivlen|.  |hp_ctx| is a packet header
- * protection cipher context object.
+ * `ngtcp2_conn_get_datagram_queue_len` returns the number of
+ * DATAGRAMs queued by `ngtcp2_conn_enqueue_datagram` which have not
+ * been written into a packet nor dropped yet.
+ */
+NGTCP2_EXTERN size_t ngtcp2_conn_get_datagram_queue_len(ngtcp2_conn *conn);
+
+/**
+ * @function
  *
- * |ivlen| must be the minimum length of AEAD nonce, or 8 bytes if
- * that is larger.
+ * `ngtcp2_conn_protect_pkts` encrypts and applies header protection
+ * to the 1RTT packets which have been written by the packet writing
+ * functions (e.g., `ngtcp2_conn_writev_stream`), but not protected
+ * yet.
  *
- * If this function succeeds, |conn| takes ownership of |aead_ctx| and
- * |hp_ctx|.  :type:`ngtcp2_delete_crypto_aead_ctx` and
- * :type:`ngtcp2_delete_crypto_cipher_ctx` will be called to delete
- * these objects when they are no longer used.  If this function
- * fails, the caller is responsible to delete them.
+ * If :member:`ngtcp2_callbacks.encrypt_batch` is specified, the
+ * packet writing functions do not protect 1RTT packets immediately.
+ * Instead, they are protected in bulk by
+ * :member:`ngtcp2_callbacks.encrypt_batch` when this function is
+ * called.  The library may protect the pending packets earlier, for
+ * example, when internal buffer is full or packet protection key
+ * changes.  Therefore, application must keep the buffers passed to
+ * the packet writing functions intact, and must call this function
+ * before sending the packets written to them.  Typically, application
+ * writes packets for a GSO burst into a single buffer, and calls this
+ * function just before sending it.
+ *
+ * If there is no packet to protect, this function does nothing and
+ * returns 0.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
  *
- * :macro:`NGTCP2_ERR_NOMEM`
- *     Out of memory.
+ * :macro:`NGTCP2_ERR_INVALID_STATE`
+ *     A job detached by `ngtcp2_conn_detach_protect_job` is
+ *     outstanding.
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`
+ *     User-defined callback function failed.
  */
-NGTCP2_EXTERN int ngtcp2_conn_install_rx_key(
-    ngtcp2_conn *conn, const uint8_t *secret, size_t secretlen,
-    const ngtcp2_crypto_aead_ctx *aead_ctx, const uint8_t *iv, size_t ivlen,
-    const ngtcp2_crypto_cipher_ctx *hp_ctx);
+NGTCP2_EXTERN int ngtcp2_conn_protect_pkts(ngtcp2_conn *conn);
 
 /**
- * @function
- *
- * `ngtcp2_conn_install_tx_key` installs packet protection keying
- * materials for encrypting Short header packets.  |secret| of length
- * |secretlen| is the encryption secret which is used to derive keying
- * materials passed to this function.  |aead_ctx| is AEAD cipher
- * context object which must be initialized with an encryption key.
- * |iv| is IV of length |ivlen|.  |hp_ctx| is a packet header
- * protection cipher context object.
+ * @struct
  *
- * |ivlen| must be the minimum length of AEAD nonce, or 8 bytes if
- * that is larger.
+ * :type:`ngtcp2_protect_job` is a batch of 1RTT packets whose
+ * protection is deferred, detached from :type:`ngtcp2_conn` by
+ * `ngtcp2_conn_detach_protect_job` so that it can be protected on
+ * another thread.  The details are intentionally hidden.
+ */
+typedef struct ngtcp2_protect_job ngtcp2_protect_job;
+
+/**
+ * @function
  *
- * If this function succeeds, |conn| takes ownership of |aead_ctx| and
- * |hp_ctx|.  :type:`ngtcp2_delete_crypto_aead_ctx` and
- * :type:`ngtcp2_delete_crypto_cipher_ctx` will be called to delete
- * these objects when they are no longer used.  If this function
- * fails, the caller is responsible to delete them.
+ * `ngtcp2_conn_detach_protect_job` moves the 1RTT packets which
+ * `ngtcp2_conn_protect_pkts` would protect into a newly allocated
+ * job, and assigns it to |*pjob|.  The job is protected by
+ * `ngtcp2_protect_job_run` which may be called from any thread.
+ * After it returns, the application must call
+ * `ngtcp2_conn_release_protect_job` from the thread which owns
+ * |conn|.  This lets the connection thread write the next burst of
+ * packets while another thread encrypts the previous one.
+ *
+ * The packets must not be sent until `ngtcp2_protect_job_run`
+ * returns.  The buffers which the packets are written to must be
+ * kept intact until then.
+ *
+ * The job refers to the encryption key of |conn|.  The library keeps
+ * the key alive until all jobs which refer to it are released, even
+ * if the key is discarded by key update in the meantime.  While a
+ * job is outstanding, the library never protects packets with
+ * :member:`ngtcp2_callbacks.encrypt_batch` on the connection thread:
+ * the packet writing functions return 0 when no more packets can be
+ * deferred, and `ngtcp2_conn_read_pkt` and
+ * `ngtcp2_conn_initiate_key_update` return
+ * :macro:`NGTCP2_ERR_INVALID_STATE` if there are pending packets.
+ * Therefore, application should detach a job after every burst.
+ * The crypto contexts of ngtcp2_crypto helper libraries must not be
+ * used by multiple threads at once.  If the callbacks use them,
+ * application must not run multiple jobs of the same connection
+ * concurrently.  Jobs of different connections can run in parallel.
+ *
+ * If there is no pending packet, this function assigns NULL to
+ * |*pjob|, and returns 0.
+ *
+ * All jobs must be released before |conn| is deleted.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -4007,833 +7137,1133 @@ NGTCP2_EXTERN int ngtcp2_conn_install_rx_key(
  * :macro:`NGTCP2_ERR_NOMEM`
  *     Out of memory.
  */
-NGTCP2_EXTERN int ngtcp2_conn_install_tx_key(
-    ngtcp2_conn *conn, const uint8_t *secret, size_t secretlen,
-    const ngtcp2_crypto_aead_ctx *aead_ctx, const uint8_t *iv, size_t ivlen,
-    const ngtcp2_crypto_cipher_ctx *hp_ctx);
+NGTCP2_EXTERN int ngtcp2_conn_detach_protect_job(ngtcp2_conn *conn,
+                                                 ngtcp2_protect_job **pjob);
 
 /**
  * @function
  *
- * `ngtcp2_conn_initiate_key_update` initiates the key update.
+ * `ngtcp2_protect_job_run` encrypts and applies header protection to
+ * the packets in |job| by calling
+ * :member:`ngtcp2_callbacks.encrypt_batch` and
+ * :member:`ngtcp2_callbacks.hp_mask_batch` of the connection which
+ * |job| is detached from.  This function does not touch the
+ * connection, and may be called from any thread.  It must be called
+ * at most once for each job.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
  *
- * :macro:`NGTCP2_ERR_INVALID_STATE`
- *     The previous key update has not been confirmed yet; or key
- *     update is too frequent; or new keys are not available yet.
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`
+ *     User-defined callback function failed.
  */
-NGTCP2_EXTERN int ngtcp2_conn_initiate_key_update(ngtcp2_conn *conn,
-                                                  ngtcp2_tstamp ts);
+NGTCP2_EXTERN int ngtcp2_protect_job_run(ngtcp2_protect_job *job);
 
 /**
  * @function
  *
- * `ngtcp2_conn_set_tls_error` sets the TLS related error |liberr| in
- * |conn|.  |liberr| must be one of ngtcp2 library error codes (which
- * is defined as NGTCP2_ERR_* macro, such as
- * :macro:`NGTCP2_ERR_DECRYPT`).  In general, error code should be
- * propagated via return value, but sometimes ngtcp2 API is called
- * inside callback function of TLS stack and it does not allow to
- * return ngtcp2 error code directly.  In this case, implementation
- * can set the error code (e.g.,
- * :macro:`NGTCP2_ERR_MALFORMED_TRANSPORT_PARAM`) using this function.
+ * `ngtcp2_conn_release_protect_job` frees |job| which was detached
+ * from |conn| by `ngtcp2_conn_detach_protect_job`.  If |job| is the
+ * last job which refers to a discarded encryption key, the key is
+ * deleted as well.  |job| may be released without being run, for
+ * example, when the connection is being closed.
+ *
+ * If |job| is NULL, this function does nothing.
  */
-NGTCP2_EXTERN void ngtcp2_conn_set_tls_error(ngtcp2_conn *conn, int liberr);
+NGTCP2_EXTERN void ngtcp2_conn_release_protect_job(ngtcp2_conn *conn,
+                                                   ngtcp2_protect_job *job);
 
 /**
  * @function
  *
- * `ngtcp2_conn_get_tls_error` returns the value set by
- * `ngtcp2_conn_set_tls_error`.  If no value is set, this function
- * returns 0.
+ * `ngtcp2_conn_prepare_rx_hp_masks` produces the header protection
+ * masks of 1RTT packets in |pktv| of length |pktvcnt| in bulk before
+ * they are passed to `ngtcp2_conn_read_pkt`.  Each element of |pktv|
+ * is a UDP datagram.  It is intended to be called with the datagrams
+ * received for |conn| at once, for example, the segments of UDP GRO
+ * buffer.  The datagrams which do not start with 1RTT packet are
+ * ignored.
+ *
+ * When `ngtcp2_conn_read_pkt` is later called with one of these
+ * datagrams, the precomputed mask is used instead of calling
+ * :member:`ngtcp2_callbacks.hp_mask`.  The mask is only used if the
+ * sample in the datagram is unchanged.  At most 64 datagrams are
+ * processed, and the rest of them are ignored.  The masks precomputed
+ * by the previous call of this function are discarded.
+ *
+ * :member:`ngtcp2_callbacks.hp_mask_batch` is used to produce the
+ * masks if it is specified.  If 1RTT key has not been installed yet,
+ * this function does nothing.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
+ * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`
+ *     User-defined callback function failed.
  */
-NGTCP2_EXTERN int ngtcp2_conn_get_tls_error(ngtcp2_conn *conn);
+NGTCP2_EXTERN int ngtcp2_conn_prepare_rx_hp_masks(ngtcp2_conn *conn,
+                                                  const ngtcp2_vec *pktv,
+                                                  size_t pktvcnt);
 
 /**
  * @function
  *
- * `ngtcp2_conn_set_tls_alert` sets a TLS alert |alert| generated by a
- * local endpoint to |conn|.
+ * `ngtcp2_conn_is_in_closing_period` returns nonzero if |conn| is in
+ * the closing period.
  */
-NGTCP2_EXTERN void ngtcp2_conn_set_tls_alert(ngtcp2_conn *conn, uint8_t alert);
+NGTCP2_EXTERN int ngtcp2_conn_is_in_closing_period(ngtcp2_conn *conn);
 
 /**
  * @function
  *
- * `ngtcp2_conn_get_tls_alert` returns the value set by
- * `ngtcp2_conn_set_tls_alert`.  If no value is set, this function
- * returns 0.
+ * `ngtcp2_conn_is_in_draining_period` returns nonzero if |conn| is in
+ * the draining period.
  */
-NGTCP2_EXTERN uint8_t ngtcp2_conn_get_tls_alert(ngtcp2_conn *conn);
+NGTCP2_EXTERN int ngtcp2_conn_is_in_draining_period(ngtcp2_conn *conn);
 
 /**
  * @function
  *
- * `ngtcp2_conn_set_keep_alive_timeout` sets keep-alive timeout.  If
- * nonzero value is given, after a connection is idle at least in a
- * given amount of time, a keep-alive packet is sent.  If 0 is set,
- * keep-alive functionality is disabled and this is the default.
+ * `ngtcp2_conn_attach_stream_buf` attaches an application buffer
+ * identified by |buf_user_data| to the next |datalen| bytes of the
+ * outgoing data of a stream denoted by |stream_id| to which no buffer
+ * is attached yet.  The buffers are attached in the order of stream
+ * offset starting from 0, and the application may attach a buffer
+ * before or after it passes the data to `ngtcp2_conn_writev_stream`.
+ *
+ * The data passed to `ngtcp2_conn_writev_stream` must stay valid
+ * until :member:`ngtcp2_callbacks.release_stream_buf` is called with
+ * |buf_user_data|.  Since the callback is called when all data in
+ * the buffer are acknowledged, the application can share a buffer
+ * among many connections by reference counting it, instead of
+ * tracking :member:`ngtcp2_callbacks.acked_stream_data_offset`.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
+ * :macro:`NGTCP2_ERR_STREAM_NOT_FOUND`
+ *     Stream does not exist.
  */
-NGTCP2_EXTERN void ngtcp2_conn_set_keep_alive_timeout(ngtcp2_conn *conn,
-                                                      ngtcp2_duration timeout);
+NGTCP2_EXTERN int ngtcp2_conn_attach_stream_buf(ngtcp2_conn *conn,
+                                                int64_t stream_id,
+                                                uint64_t datalen,
+                                                void *buf_user_data);
 
 /**
  * @function
  *
- * `ngtcp2_conn_get_expiry` returns the next expiry time.
+ * `ngtcp2_conn_set_stream_sendbuf` makes |conn| own the outgoing data
+ * of a stream denoted by |stream_id| which the application has not
+ * passed to `ngtcp2_conn_writev_stream` yet.  The library holds at
+ * most |maxlen| bytes of unacknowledged data for the stream in a
+ * list of fixed size chunks, and releases a chunk when all data in it
+ * are acknowledged.
+ *
+ * After this function succeeds, the application appends data to the
+ * stream by `ngtcp2_conn_buffer_stream_data`, and sends them by
+ * `ngtcp2_conn_writev_stream` with |stream_id| and no data.  The
+ * buffered data are retransmitted by the library, and the application
+ * does not have to keep them until
+ * :member:`ngtcp2_callbacks.acked_stream_data_offset` is called.
+ * `ngtcp2_conn_writev_streams` and `ngtcp2_conn_write_burst` do not
+ * send the buffered data.
  *
- * Call `ngtcp2_conn_handle_expiry()` and `ngtcp2_conn_write_pkt` (or
- * `ngtcp2_conn_writev_stream`) if expiry time is passed.
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
+ * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     |maxlen| is 0.
+ * :macro:`NGTCP2_ERR_STREAM_NOT_FOUND`
+ *     Stream does not exist.
+ * :macro:`NGTCP2_ERR_INVALID_STATE`
+ *     The send buffer has already been set, or the stream is shut
+ *     for writing.
  */
-NGTCP2_EXTERN ngtcp2_tstamp ngtcp2_conn_get_expiry(ngtcp2_conn *conn);
+NGTCP2_EXTERN int ngtcp2_conn_set_stream_sendbuf(ngtcp2_conn *conn,
+                                                 int64_t stream_id,
+                                                 size_t maxlen);
 
 /**
  * @function
  *
- * `ngtcp2_conn_handle_expiry` handles expired timer.  It does nothing
- * if timer is not expired.
+ * `ngtcp2_conn_buffer_stream_data` copies at most |datalen| bytes of
+ * |data| to the send buffer of a stream denoted by |stream_id| which
+ * is set by `ngtcp2_conn_set_stream_sendbuf`.  The number of bytes
+ * copied is limited by the space left in the buffer, which grows as
+ * the buffered data are acknowledged.  If
+ * :macro:`NGTCP2_WRITE_STREAM_FLAG_FIN` is set in |flags|, and all
+ * data are copied, the last byte becomes the final byte of the
+ * stream.
+ *
+ * This function returns the number of bytes copied, which might be
+ * 0, if it succeeds, or one of the following negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
+ * :macro:`NGTCP2_ERR_STREAM_NOT_FOUND`
+ *     Stream does not exist.
+ * :macro:`NGTCP2_ERR_STREAM_SHUT_WR`
+ *     Stream is half closed (local); or stream is being reset.
+ * :macro:`NGTCP2_ERR_INVALID_STATE`
+ *     The send buffer is not set, or the final byte has already been
+ *     buffered.
  */
-NGTCP2_EXTERN int ngtcp2_conn_handle_expiry(ngtcp2_conn *conn,
-                                            ngtcp2_tstamp ts);
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_conn_buffer_stream_data(
+    ngtcp2_conn *conn, int64_t stream_id, uint32_t flags, const uint8_t *data,
+    size_t datalen);
 
 /**
  * @function
  *
- * `ngtcp2_conn_get_pto` returns Probe Timeout (PTO).
+ * `ngtcp2_conn_release_stream_data` tells |conn| that the application
+ * no longer uses the stream data loaned with
+ * :macro:`NGTCP2_STREAM_DATA_FLAG_LOANED` up to the stream offset
+ * |offset|, exclusive, of a stream denoted by |stream_id|.  The
+ * memory which only holds the released data is freed.  If the stream
+ * does not exist, this function does nothing.
  */
-NGTCP2_EXTERN ngtcp2_duration ngtcp2_conn_get_pto(ngtcp2_conn *conn);
+NGTCP2_EXTERN void ngtcp2_conn_release_stream_data(ngtcp2_conn *conn,
+                                                   int64_t stream_id,
+                                                   uint64_t offset);
 
 /**
- * @function
- *
- * `ngtcp2_conn_decode_remote_transport_params` decodes QUIC transport
- * parameters from the buffer pointed by |data| of length |datalen|,
- * and sets the result to |conn|.
- *
- * This function returns 0 if it succeeds, or one of the following
- * negative error codes:
+ * @macro
  *
- * :macro:`NGTCP2_ERR_REQUIRED_TRANSPORT_PARAM`
- *     The required parameter is missing.
- * :macro:`NGTCP2_ERR_MALFORMED_TRANSPORT_PARAM`
- *     The input is malformed.
- * :macro:`NGTCP2_ERR_TRANSPORT_PARAM`
- *     Failed to validate the remote QUIC transport parameters.
- * :macro:`NGTCP2_ERR_VERSION_NEGOTIATION_FAILURE`
- *     Version negotiation failure.
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`
- *     User callback failed
+ * :macro:`NGTCP2_DEFAULT_URGENCY` is the default urgency of a stream.
  */
-NGTCP2_EXTERN int
-ngtcp2_conn_decode_remote_transport_params(ngtcp2_conn *conn,
-                                           const uint8_t *data, size_t datalen);
+#define NGTCP2_DEFAULT_URGENCY 3
 
 /**
- * @function
+ * @macro
  *
- * `ngtcp2_conn_get_remote_transport_params` returns a pointer to the
- * remote QUIC transport parameters.  If no remote transport
- * parameters are set, it returns NULL.
+ * :macro:`NGTCP2_URGENCY_LEVELS` is the number of urgency levels.
  */
-NGTCP2_EXTERN const ngtcp2_transport_params *
-ngtcp2_conn_get_remote_transport_params(ngtcp2_conn *conn);
+#define NGTCP2_URGENCY_LEVELS 8
 
 /**
- * @function
- *
- * `ngtcp2_conn_set_early_remote_transport_params` sets |params| as
- * transport parameters previously received from a server.  The
- * parameters are used to send early data.  QUIC requires that client
- * application should remember transport parameters along with a
- * session ticket.
- *
- * At least following fields should be set:
- *
- * - initial_max_stream_id_bidi
- * - initial_max_stream_id_uni
- * - initial_max_stream_data_bidi_local
- * - initial_max_stream_data_bidi_remote
- * - initial_max_stream_data_uni
- * - initial_max_data
- * - active_connection_id_limit
- * - max_datagram_frame_size (if DATAGRAM extension was negotiated)
- *
- * The following fields are ignored:
+ * @macro
  *
- * - ack_delay_exponent
- * - max_ack_delay
- * - initial_scid
- * - original_dcid
- * - preferred_address and preferred_address_present
- * - retry_scid and retry_scid_present
- * - stateless_reset_token and stateless_reset_token_present
+ * :macro:`NGTCP2_DEFAULT_STREAM_WEIGHT` is the default weight of a
+ * stream.
  */
-NGTCP2_EXTERN void ngtcp2_conn_set_early_remote_transport_params_versioned(
-    ngtcp2_conn *conn, int transport_params_version,
-    const ngtcp2_transport_params *params);
+#define NGTCP2_DEFAULT_STREAM_WEIGHT 16
 
 /**
- * @function
- *
- * `ngtcp2_conn_set_local_transport_params` sets the local transport
- * parameters |params|.  This function can only be called by server.
- * Although the local transport parameters are passed to
- * `ngtcp2_conn_server_new`, server might want to update them after
- * ALPN is chosen.  In that case, server can update the transport
- * parameter with this function.  Server must call this function
- * before calling `ngtcp2_conn_install_tx_handshake_key`.
- *
- * This function returns 0 if it succeeds, or one of the following
- * negative error codes:
+ * @macro
  *
- * :macro:`NGTCP2_ERR_INVALID_STATE`
- *     `ngtcp2_conn_install_tx_handshake_key` has been called.
+ * :macro:`NGTCP2_MAX_STREAM_WEIGHT` is the maximum weight of a
+ * stream.
  */
-NGTCP2_EXTERN int ngtcp2_conn_set_local_transport_params_versioned(
-    ngtcp2_conn *conn, int transport_params_version,
-    const ngtcp2_transport_params *params);
+#define NGTCP2_MAX_STREAM_WEIGHT 256
 
 /**
- * @function
+ * @struct
  *
- * `ngtcp2_conn_get_local_transport_params` returns a pointer to the
- * local QUIC transport parameters.
+ * :type:`ngtcp2_stream_priority` is the priority of a stream.
  */
-NGTCP2_EXTERN const ngtcp2_transport_params *
-ngtcp2_conn_get_local_transport_params(ngtcp2_conn *conn);
+typedef struct ngtcp2_stream_priority {
+  /**
+   * :member:`urgency` is the urgency of a stream in the range [0,
+   * :macro:`NGTCP2_URGENCY_LEVELS`).  The lower value is more
+   * urgent.  It is used by
+   * :enum:`ngtcp2_sched_policy.NGTCP2_SCHED_POLICY_STRICT_PRIORITY`.
+   */
+  uint8_t urgency;
+  /**
+   * :member:`incremental`, if nonzero, makes a stream share the
+   * bandwidth with the other incremental streams of the same urgency.
+   * It is used by
+   * :enum:`ngtcp2_sched_policy.NGTCP2_SCHED_POLICY_STRICT_PRIORITY`.
+   */
+  int incremental;
+  /**
+   * :member:`weight` is the weight of a stream in the range [1,
+   * :macro:`NGTCP2_MAX_STREAM_WEIGHT`].  It is used by
+   * :enum:`ngtcp2_sched_policy.NGTCP2_SCHED_POLICY_WEIGHTED_FAIR`.
+   */
+  uint32_t weight;
+} ngtcp2_stream_priority;
 
 /**
  * @function
  *
- * `ngtcp2_conn_encode_local_transport_params` encodes the local QUIC
- * transport parameters in |dest| of length |destlen|.  This is
- * equivalent to calling `ngtcp2_conn_get_local_transport_params` and
- * then `ngtcp2_encode_transport_params`.
+ * `ngtcp2_conn_set_stream_priority` sets the priority of a stream
+ * denoted by |stream_id| to |pri|.  A stream has
+ * :macro:`NGTCP2_DEFAULT_URGENCY`, non-incremental, and
+ * :macro:`NGTCP2_DEFAULT_STREAM_WEIGHT` initially.  Which fields take
+ * effect depends on :member:`ngtcp2_settings.sched_policy`.
  *
- * This function returns the number of written, or one of the
- * following negative error codes:
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     :member:`ngtcp2_stream_priority.urgency` or
+ *     :member:`ngtcp2_stream_priority.weight` is out of range.
+ * :macro:`NGTCP2_ERR_STREAM_NOT_FOUND`
+ *     Stream does not exist.
+ */
+NGTCP2_EXTERN int
+ngtcp2_conn_set_stream_priority(ngtcp2_conn *conn, int64_t stream_id,
+                                const ngtcp2_stream_priority *pri);
+
+/**
+ * @macro
  *
- * :macro:`NGTCP2_ERR_NOBUF`
- *     Buffer is too small.
+ * :macro:`NGTCP2_MAX_FEC_SYMBOLCNT` is the maximum number of STREAM
+ * frames that a single REPAIR frame protects.
  */
-NGTCP2_EXTERN ngtcp2_ssize ngtcp2_conn_encode_local_transport_params(
-    ngtcp2_conn *conn, uint8_t *dest, size_t destlen);
+#define NGTCP2_MAX_FEC_SYMBOLCNT 16
 
 /**
  * @function
  *
- * `ngtcp2_conn_open_bidi_stream` opens new bidirectional stream.  The
- * |stream_user_data| is the user data specific to the stream.  The
- * open stream ID is stored in |*pstream_id|.
- *
- * Application can call this function before handshake completes.  For
- * 0RTT packet, application can call this function after calling
- * `ngtcp2_conn_set_early_remote_transport_params`.  For 1RTT packet,
- * application can call this function after calling
- * `ngtcp2_conn_decode_remote_transport_params` and
- * `ngtcp2_conn_install_tx_key`.  If ngtcp2 crypto support library is
- * used, application can call this function after calling
- * `ngtcp2_crypto_derive_and_install_tx_key` for 1RTT packet.
+ * `ngtcp2_conn_set_stream_fec` enables the experimental forward error
+ * correction for the data sent to a stream denoted by |stream_id|.
+ * After every |symbolcnt| STREAM frames carrying new data, a REPAIR
+ * frame which contains XOR of their data is sent.  A REPAIR frame is
+ * also sent when the data passed to `ngtcp2_conn_writev_stream` have
+ * been written entirely, so that the end of each write is protected
+ * without waiting for more data.  If a single STREAM frame of a group
+ * is lost, the remote endpoint reconstructs it from the REPAIR frame
+ * and the other STREAM frames instead of waiting for the
+ * retransmission.  This trades bandwidth for latency, and is meant
+ * for latency sensitive streams on lossy paths.  The lost frame is
+ * still retransmitted.  REPAIR frame is never retransmitted.
+ *
+ * STREAM frames of the stream become slightly shorter so that a
+ * REPAIR frame fits in a packet.  The range of data covered by a
+ * REPAIR frame never exceeds the half of the remote
+ * :member:`ngtcp2_transport_params.fec_window`.
+ *
+ * Specifying 0 to |symbolcnt| disables the forward error correction.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
  *
+ * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     |symbolcnt| is larger than :macro:`NGTCP2_MAX_FEC_SYMBOLCNT`.
+ * :macro:`NGTCP2_ERR_INVALID_STATE`
+ *     Either endpoint has not advertised
+ *     :member:`ngtcp2_transport_params.fec_window`.
+ * :macro:`NGTCP2_ERR_STREAM_NOT_FOUND`
+ *     Stream does not exist.
  * :macro:`NGTCP2_ERR_NOMEM`
- *     Out of memory
- * :macro:`NGTCP2_ERR_STREAM_ID_BLOCKED`
- *     The remote peer does not allow |stream_id| yet.
+ *     Out of memory.
  */
-NGTCP2_EXTERN int ngtcp2_conn_open_bidi_stream(ngtcp2_conn *conn,
-                                               int64_t *pstream_id,
-                                               void *stream_user_data);
+NGTCP2_EXTERN int ngtcp2_conn_set_stream_fec(ngtcp2_conn *conn,
+                                             int64_t stream_id,
+                                             size_t symbolcnt);
 
 /**
  * @function
  *
- * `ngtcp2_conn_open_uni_stream` opens new unidirectional stream.  The
- * |stream_user_data| is the user data specific to the stream.  The
- * open stream ID is stored in |*pstream_id|.
- *
- * Application can call this function before handshake completes.  For
- * 0RTT packet, application can call this function after calling
- * `ngtcp2_conn_set_early_remote_transport_params`.  For 1RTT packet,
- * application can call this function after calling
- * `ngtcp2_conn_decode_remote_transport_params` and
- * `ngtcp2_conn_install_tx_key`.  If ngtcp2 crypto support library is
- * used, application can call this function after calling
- * `ngtcp2_crypto_derive_and_install_tx_key` for 1RTT packet.
+ * `ngtcp2_conn_schedule_stream` tells the library that a stream
+ * denoted by |stream_id| has data to send.  The application then asks
+ * `ngtcp2_conn_get_scheduled_stream` which stream to pass to
+ * `ngtcp2_conn_writev_stream` next, instead of choosing a stream by
+ * itself.  The stream stays scheduled until the application calls
+ * `ngtcp2_conn_unschedule_stream`, the stream sends a STREAM frame
+ * with fin bit set, or the stream is shut down for writing.  It is
+ * not an error to schedule a stream which is already scheduled.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
  *
  * :macro:`NGTCP2_ERR_NOMEM`
- *     Out of memory
- * :macro:`NGTCP2_ERR_STREAM_ID_BLOCKED`
- *     The remote peer does not allow |stream_id| yet.
+ *     Out of memory.
+ * :macro:`NGTCP2_ERR_STREAM_NOT_FOUND`
+ *     Stream does not exist.
+ * :macro:`NGTCP2_ERR_STREAM_SHUT_WR`
+ *     Stream is shut down for writing.
  */
-NGTCP2_EXTERN int ngtcp2_conn_open_uni_stream(ngtcp2_conn *conn,
-                                              int64_t *pstream_id,
-                                              void *stream_user_data);
+NGTCP2_EXTERN int ngtcp2_conn_schedule_stream(ngtcp2_conn *conn,
+                                              int64_t stream_id);
 
 /**
  * @function
  *
- * `ngtcp2_conn_shutdown_stream` closes stream denoted by |stream_id|
- * abruptly.  |app_error_code| is one of application error codes, and
- * indicates the reason of shutdown.  Successful call of this function
- * does not immediately erase the state of the stream.  The actual
- * deletion is done when the remote endpoint sends acknowledgement.
- * Calling this function is equivalent to call
- * `ngtcp2_conn_shutdown_stream_read`, and
- * `ngtcp2_conn_shutdown_stream_write` sequentially.
- *
- * This function returns 0 if it succeeds, or one of the following
- * negative error codes:
+ * `ngtcp2_conn_unschedule_stream` removes a stream denoted by
+ * |stream_id| from the streams scheduled by
+ * `ngtcp2_conn_schedule_stream`.  The application should call this
+ * function when the stream has no data to send for now, or it is
+ * blocked by stream level flow control.
+ */
+NGTCP2_EXTERN void ngtcp2_conn_unschedule_stream(ngtcp2_conn *conn,
+                                                 int64_t stream_id);
+
+/**
+ * @function
  *
- * :macro:`NGTCP2_ERR_NOMEM`
- *     Out of memory
+ * `ngtcp2_conn_get_scheduled_stream` returns the stream ID of the
+ * stream which should send data next according to
+ * :member:`ngtcp2_settings.sched_policy`.  Once the stream writes a
+ * STREAM frame with `ngtcp2_conn_writev_stream`, it is moved to the
+ * position decided by the policy.  This function returns -1 if no
+ * stream is scheduled.
  */
-NGTCP2_EXTERN int ngtcp2_conn_shutdown_stream(ngtcp2_conn *conn,
-                                              int64_t stream_id,
-                                              uint64_t app_error_code);
+NGTCP2_EXTERN int64_t ngtcp2_conn_get_scheduled_stream(ngtcp2_conn *conn);
 
 /**
  * @function
  *
- * `ngtcp2_conn_shutdown_stream_write` closes write-side of stream
- * denoted by |stream_id| abruptly.  |app_error_code| is one of
- * application error codes, and indicates the reason of shutdown.  If
- * this function succeeds, no application data is sent to the remote
- * endpoint.  It discards all data which has not been acknowledged
- * yet.
+ * `ngtcp2_conn_extend_max_stream_offset` extends stream's max stream
+ * data value by |datalen|.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
  *
  * :macro:`NGTCP2_ERR_NOMEM`
- *     Out of memory
+ *     Out of memory.
  */
-NGTCP2_EXTERN int ngtcp2_conn_shutdown_stream_write(ngtcp2_conn *conn,
-                                                    int64_t stream_id,
-                                                    uint64_t app_error_code);
+NGTCP2_EXTERN int ngtcp2_conn_extend_max_stream_offset(ngtcp2_conn *conn,
+                                                       int64_t stream_id,
+                                                       uint64_t datalen);
 
 /**
  * @function
  *
- * `ngtcp2_conn_shutdown_stream_read` closes read-side of stream
- * denoted by |stream_id| abruptly.  |app_error_code| is one of
- * application error codes, and indicates the reason of shutdown.  If
- * this function succeeds, no application data is forwarded to an
- * application layer.
+ * `ngtcp2_conn_extend_max_offset` extends max data offset by
+ * |datalen|.
+ */
+NGTCP2_EXTERN void ngtcp2_conn_extend_max_offset(ngtcp2_conn *conn,
+                                                 uint64_t datalen);
+
+/**
+ * @function
  *
- * This function returns 0 if it succeeds, or one of the following
- * negative error codes:
+ * `ngtcp2_conn_extend_max_streams_bidi` extends the number of maximum
+ * local bidirectional streams that a remote endpoint can open by |n|.
  *
- * :macro:`NGTCP2_ERR_NOMEM`
- *     Out of memory
+ * The library does not increase maximum stream limit automatically
+ * unless :member:`ngtcp2_settings.auto_max_streams` is nonzero, in
+ * which case this function must not be called.  The exception is
+ * when a stream is closed without :type:`ngtcp2_stream_open`
+ * callback being called.  In this case, stream limit is increased
+ * automatically.
  */
-NGTCP2_EXTERN int ngtcp2_conn_shutdown_stream_read(ngtcp2_conn *conn,
-                                                   int64_t stream_id,
-                                                   uint64_t app_error_code);
+NGTCP2_EXTERN void ngtcp2_conn_extend_max_streams_bidi(ngtcp2_conn *conn,
+                                                       size_t n);
 
 /**
- * @macrosection
+ * @function
  *
- * Write stream data flags
+ * `ngtcp2_conn_extend_max_streams_uni` extends the number of maximum
+ * local unidirectional streams that a remote endpoint can open by
+ * |n|.
+ *
+ * The library does not increase maximum stream limit automatically
+ * unless :member:`ngtcp2_settings.auto_max_streams` is nonzero, in
+ * which case this function must not be called.  The exception is
+ * when a stream is closed without :type:`ngtcp2_stream_open`
+ * callback being called.  In this case, stream limit is increased
+ * automatically.
  */
+NGTCP2_EXTERN void ngtcp2_conn_extend_max_streams_uni(ngtcp2_conn *conn,
+                                                      size_t n);
 
 /**
- * @macro
+ * @function
  *
- * :macro:`NGTCP2_WRITE_STREAM_FLAG_NONE` indicates no flag set.
+ * `ngtcp2_conn_get_dcid` returns the non-NULL pointer to destination
+ * connection ID.  If no destination connection ID is present, the
+ * return value is not ``NULL``, and its datalen field is 0.
  */
-#define NGTCP2_WRITE_STREAM_FLAG_NONE 0x00u
+NGTCP2_EXTERN const ngtcp2_cid *ngtcp2_conn_get_dcid(ngtcp2_conn *conn);
 
 /**
- * @macro
+ * @function
  *
- * :macro:`NGTCP2_WRITE_STREAM_FLAG_MORE` indicates that more data may
- * come and should be coalesced into the same packet if possible.
+ * `ngtcp2_conn_get_client_initial_dcid` returns the non-NULL pointer
+ * to the Destination Connection ID that client sent in its Initial
+ * packet.
  */
-#define NGTCP2_WRITE_STREAM_FLAG_MORE 0x01u
+NGTCP2_EXTERN const ngtcp2_cid *
+ngtcp2_conn_get_client_initial_dcid(ngtcp2_conn *conn);
 
 /**
- * @macro
+ * @function
  *
- * :macro:`NGTCP2_WRITE_STREAM_FLAG_FIN` indicates that the passed
- * data is the final part of a stream.
+ * `ngtcp2_conn_get_num_scid` returns the number of source connection
+ * IDs which the local endpoint has provided to the peer and have not
+ * retired.
  */
-#define NGTCP2_WRITE_STREAM_FLAG_FIN 0x02u
+NGTCP2_EXTERN size_t ngtcp2_conn_get_num_scid(ngtcp2_conn *conn);
 
 /**
  * @function
  *
- * `ngtcp2_conn_write_stream` is just like
- * `ngtcp2_conn_writev_stream`.  The only difference is that it
- * conveniently accepts a single buffer.
+ * `ngtcp2_conn_get_scid` writes the all source connection IDs which
+ * the local endpoint has provided to the peer and have not retired in
+ * |dest|.  The buffer pointed by |dest| must have
+ * ``sizeof(ngtcp2_cid) * n`` bytes available, where n is the return
+ * value of `ngtcp2_conn_get_num_scid()`.
  */
-NGTCP2_EXTERN ngtcp2_ssize ngtcp2_conn_write_stream_versioned(
-    ngtcp2_conn *conn, ngtcp2_path *path, int pkt_info_version,
-    ngtcp2_pkt_info *pi, uint8_t *dest, size_t destlen, ngtcp2_ssize *pdatalen,
-    uint32_t flags, int64_t stream_id, const uint8_t *data, size_t datalen,
-    ngtcp2_tstamp ts);
+NGTCP2_EXTERN size_t ngtcp2_conn_get_scid(ngtcp2_conn *conn, ngtcp2_cid *dest);
 
 /**
  * @function
  *
- * `ngtcp2_conn_writev_stream` writes a packet containing stream data
- * of stream denoted by |stream_id|.  The buffer of the packet is
- * pointed by |dest| of length |destlen|.  This function performs QUIC
- * handshake as well.
- *
- * |destlen| should be at least
- * :member:`ngtcp2_settings.max_udp_payload_size`.
- *
- * Specifying -1 to |stream_id| means no new stream data to send.
- *
- * If |path| is not ``NULL``, this function stores the network path
- * with which the packet should be sent.  Each addr field must point
- * to the buffer which should be at least ``sizeof(struct
- * sockaddr_storage)`` bytes long.  The assignment might not be done
- * if nothing is written to |dest|.
- *
- * If |pi| is not ``NULL``, this function stores packet metadata in it
- * if it succeeds.  The metadata includes ECN markings.  When calling
- * this function again after it returns
- * :macro:`NGTCP2_ERR_WRITE_MORE`, caller must pass the same |pi| to
- * this function.
- *
- * If the all given data is encoded as STREAM frame in |dest|, and if
- * |flags| & :macro:`NGTCP2_WRITE_STREAM_FLAG_FIN` is nonzero, fin
- * flag is set to outgoing STREAM frame.  Otherwise, fin flag in
- * STREAM frame is not set.
- *
- * This packet may contain frames other than STREAM frame.  The packet
- * might not contain STREAM frame if other frames occupy the packet.
- * In that case, |*pdatalen| would be -1 if |pdatalen| is not
- * ``NULL``.
- *
- * If |flags| & :macro:`NGTCP2_WRITE_STREAM_FLAG_FIN` is nonzero, and
- * 0 length STREAM frame is successfully serialized, |*pdatalen| would
- * be 0.
- *
- * The number of data encoded in STREAM frame is stored in |*pdatalen|
- * if it is not ``NULL``.  The caller must keep the portion of data
- * covered by |*pdatalen| bytes in tact until
- * :type:`ngtcp2_acked_stream_data_offset` indicates that they are
- * acknowledged by a remote endpoint or the stream is closed.
- *
- * If |flags| equals to :macro:`NGTCP2_WRITE_STREAM_FLAG_NONE`, this
- * function produces a single payload of UDP packet.  If the given
- * stream data is small (e.g., few bytes), the packet might be
- * severely under filled.  Too many small packet might increase
- * overall packet processing costs.  Unless there are retransmissions,
- * by default, application can only send 1 STREAM frame in one QUIC
- * packet.  In order to include more than 1 STREAM frame in one QUIC
- * packet, specify :macro:`NGTCP2_WRITE_STREAM_FLAG_MORE` in |flags|.
- * This is analogous to ``MSG_MORE`` flag in :manpage:`send(2)`.  If
- * the :macro:`NGTCP2_WRITE_STREAM_FLAG_MORE` is used, there are 4
- * outcomes:
- *
- * - The function returns the written length of packet just like
- *   without :macro:`NGTCP2_WRITE_STREAM_FLAG_MORE`.  This is because
- *   packet is nearly full and the library decided to make a complete
- *   packet.  |*pdatalen| might be -1 or >= 0.
- *
- * - The function returns :macro:`NGTCP2_ERR_WRITE_MORE`.  In this
- *   case, |*pdatalen| >= 0 is asserted.  This indicates that
- *   application can call this function with different stream data (or
- *   `ngtcp2_conn_writev_datagram` if it has data to send in
- *   unreliable datagram) to pack them into the same packet.
- *   Application has to specify the same |conn|, |path|, |pi|, |dest|,
- *   |destlen|, and |ts| parameters, otherwise the behaviour is
- *   undefined.  The application can change |flags|.
+ * `ngtcp2_conn_get_num_active_dcid` returns the number of the active
+ * destination connection ID.
+ */
+NGTCP2_EXTERN size_t ngtcp2_conn_get_num_active_dcid(ngtcp2_conn *conn);
+
+/**
+ * @struct
  *
- * - The function returns :macro:`NGTCP2_ERR_STREAM_DATA_BLOCKED` which
- *   indicates that stream is blocked because of flow control.
+ * :type:`ngtcp2_cid_token` is the convenient struct to store
+ * Connection ID, its associated path, and stateless reset token.
+ */
+typedef struct ngtcp2_cid_token {
+  /**
+   * :member:`seq` is the sequence number of this Connection ID.
+   */
+  uint64_t seq;
+  /**
+   * :member:`cid` is Connection ID.
+   */
+  ngtcp2_cid cid;
+  /**
+   * :member:`ps` is the path which is associated to this Connection
+   * ID.
+   */
+  ngtcp2_path_storage ps;
+  /**
+   * :member:`token` is the stateless reset token for this Connection
+   * ID.
+   */
+  uint8_t token[NGTCP2_STATELESS_RESET_TOKENLEN];
+  /**
+   * :member:`token_present` is nonzero if token contains stateless
+   * reset token.
+   */
+  uint8_t token_present;
+} ngtcp2_cid_token;
+
+/**
+ * @function
  *
- * - The other error might be returned just like without
- *   :macro:`NGTCP2_WRITE_STREAM_FLAG_MORE`.
+ * `ngtcp2_conn_get_active_dcid` writes the all active destination
+ * connection IDs and tokens to |dest|.  The buffer pointed by |dest|
+ * must have ``sizeof(ngtcp2_cid_token) * n`` bytes available, where n
+ * is the return value of `ngtcp2_conn_get_num_active_dcid()`.
+ */
+NGTCP2_EXTERN size_t ngtcp2_conn_get_active_dcid(ngtcp2_conn *conn,
+                                                 ngtcp2_cid_token *dest);
+
+/**
+ * @function
  *
- * When application sees :macro:`NGTCP2_ERR_WRITE_MORE`, it must not
- * call other ngtcp2 API functions (application can still call
- * `ngtcp2_conn_write_connection_close` to handle error from this
- * function).  Just keep calling `ngtcp2_conn_writev_stream`,
- * `ngtcp2_conn_write_pkt`, or `ngtcp2_conn_writev_datagram` until it
- * returns a positive number (which indicates a complete packet is
- * ready).  If there is no stream data to include, call this function
- * with |stream_id| as -1 to stop coalescing and write a packet.
+ * `ngtcp2_conn_get_client_chosen_version` returns the client chosen
+ * version.
+ */
+NGTCP2_EXTERN uint32_t ngtcp2_conn_get_client_chosen_version(ngtcp2_conn *conn);
+
+/**
+ * @function
  *
- * This function returns 0 if it cannot write any frame because buffer
- * is too small, or packet is congestion limited.  Application should
- * keep reading and wait for congestion window to grow.
+ * `ngtcp2_conn_get_negotiated_version` returns the negotiated version.
  *
- * This function must not be called from inside the callback
- * functions.
+ * Until the version is negotiated, this function returns 0.
+ */
+NGTCP2_EXTERN uint32_t ngtcp2_conn_get_negotiated_version(ngtcp2_conn *conn);
+
+/**
+ * @function
  *
- * If pacing is enabled, `ngtcp2_conn_update_pkt_tx_time` must be
- * called after this function.  Application may call this function
- * multiple times before calling `ngtcp2_conn_update_pkt_tx_time`.
- * Packet pacing is enabled if BBR congestion controller algorithm is
- * used.
+ * `ngtcp2_conn_early_data_rejected` tells |conn| that early data was
+ * rejected by a server.  |conn| discards the following connection
+ * states:
  *
- * This function returns the number of bytes written in |dest| if it
- * succeeds, or one of the following negative error codes:
+ * - Any opended streams.
+ * - Stream identifier allocations.
+ * - Max data extended by `ngtcp2_conn_extend_max_offset`.
+ * - Max bidi streams extended by `ngtcp2_conn_extend_max_streams_bidi`.
+ * - Max uni streams extended by `ngtcp2_conn_extend_max_streams_uni`.
  *
- * :macro:`NGTCP2_ERR_NOMEM`
- *     Out of memory
- * :macro:`NGTCP2_ERR_STREAM_NOT_FOUND`
- *     Stream does not exist
- * :macro:`NGTCP2_ERR_STREAM_SHUT_WR`
- *     Stream is half closed (local); or stream is being reset.
- * :macro:`NGTCP2_ERR_PKT_NUM_EXHAUSTED`
- *     Packet number is exhausted, and cannot send any more packet.
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`
- *     User callback failed
- * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
- *     The total length of stream data is too large.
- * :macro:`NGTCP2_ERR_STREAM_DATA_BLOCKED`
- *     Stream is blocked because of flow control.
- * :macro:`NGTCP2_ERR_WRITE_MORE`
- *     (Only when :macro:`NGTCP2_WRITE_STREAM_FLAG_MORE` is specified)
- *     Application can call this function to pack more stream data
- *     into the same packet.  See above to know how it works.
+ * Application which wishes to retransmit early data, it has to open
+ * streams and send stream data again.
+ */
+NGTCP2_EXTERN void ngtcp2_conn_early_data_rejected(ngtcp2_conn *conn);
+
+/**
+ * @function
  *
- * In general, if the error code which satisfies
- * `ngtcp2_err_is_fatal(err) <ngtcp2_err_is_fatal>` != 0 is returned,
- * the application should just close the connection by calling
- * `ngtcp2_conn_write_connection_close` or just delete the QUIC
- * connection using `ngtcp2_conn_del`.  It is undefined to call the
- * other library functions.
+ * `ngtcp2_conn_get_conn_stat` assigns connection statistics data to
+ * |*cstat|.
  */
-NGTCP2_EXTERN ngtcp2_ssize ngtcp2_conn_writev_stream_versioned(
-    ngtcp2_conn *conn, ngtcp2_path *path, int pkt_info_version,
-    ngtcp2_pkt_info *pi, uint8_t *dest, size_t destlen, ngtcp2_ssize *pdatalen,
-    uint32_t flags, int64_t stream_id, const ngtcp2_vec *datav, size_t datavcnt,
-    ngtcp2_tstamp ts);
+NGTCP2_EXTERN void ngtcp2_conn_get_conn_stat_versioned(ngtcp2_conn *conn,
+                                                       int conn_stat_version,
+                                                       ngtcp2_conn_stat *cstat);
 
 /**
- * @macrosection
+ * @function
  *
- * Write datagram flags
+ * `ngtcp2_conn_get_published_conn_stat` assigns the connection
+ * statistics that |conn| published last time to |*cstat|.  Unlike
+ * `ngtcp2_conn_get_conn_stat`, it can be called from any thread,
+ * concurrently with the thread which processes |conn|, as long as
+ * |conn| is not deleted.  It does not block the processing thread;
+ * instead, it retries the copy if the statistics are updated in the
+ * middle of it.  The statistics are published at the end of
+ * `ngtcp2_conn_read_pkt` and `ngtcp2_conn_write_pkt` if
+ * :member:`ngtcp2_settings.publish_conn_stat` is nonzero.
+ *
+ * This function returns 0 if it succeeds, or
+ * :macro:`NGTCP2_ERR_INVALID_STATE` if
+ * :member:`ngtcp2_settings.publish_conn_stat` is not set.
  */
+NGTCP2_EXTERN int
+ngtcp2_conn_get_published_conn_stat_versioned(ngtcp2_conn *conn,
+                                              int conn_stat_version,
+                                              ngtcp2_conn_stat *cstat);
 
 /**
- * @macro
+ * @function
  *
- * :macro:`NGTCP2_WRITE_DATAGRAM_FLAG_NONE` indicates no flag set.
+ * `ngtcp2_conn_get_mem_stat` assigns the memory usage of |conn| to
+ * |*mem_stat|.  The memory usage is only counted if
+ * :member:`ngtcp2_settings.mem_budget` is nonzero.
  */
-#define NGTCP2_WRITE_DATAGRAM_FLAG_NONE 0x00u
+NGTCP2_EXTERN void
+ngtcp2_conn_get_mem_stat_versioned(ngtcp2_conn *conn, int mem_stat_version,
+                                   ngtcp2_mem_stat *mem_stat);
 
 /**
- * @macro
+ * @function
  *
- * :macro:`NGTCP2_WRITE_DATAGRAM_FLAG_MORE` indicates that more data
- * may come and should be coalesced into the same packet if possible.
+ * `ngtcp2_conn_hibernate` releases the memory which |conn| keeps for
+ * reuse but does not use at the moment: the object pools of packets,
+ * frames, and streams if none of their objects is in use, the
+ * sub-objects of closed streams, and the buffers for packet
+ * decryption and batch protection.  It is intended for connections
+ * which stay idle for a long time.  Call it when there is no data in
+ * flight, otherwise the pools which back the in-flight packets are
+ * kept.
+ *
+ * There is no need to wake |conn| up.  The released memory is
+ * allocated again on demand when |conn| receives or sends a packet.
+ *
+ * This function must not be called from inside the callback
+ * functions.
  */
-#define NGTCP2_WRITE_DATAGRAM_FLAG_MORE 0x01u
+NGTCP2_EXTERN void ngtcp2_conn_hibernate(ngtcp2_conn *conn);
 
 /**
  * @function
  *
- * `ngtcp2_conn_writev_datagram` writes a packet containing unreliable
- * data in DATAGRAM frame.  The buffer of the packet is pointed by
- * |dest| of length |destlen|.  This function performs QUIC handshake
- * as well.
+ * `ngtcp2_conn_encode_snapshot` encodes the state of the established
+ * |conn| in the buffer pointed by |dest| of length |destlen|, so that
+ * another process can take the connection over with
+ * `ngtcp2_conn_decode_and_set_snapshot`, for example during a restart
+ * of a worker process.  The snapshot includes the connection IDs, the
+ * packet numbers, the stream and flow control state, the remote
+ * transport parameters, the RTT estimate, the current 1RTT secrets,
+ * and the AEAD limits together with the number of packets encrypted
+ * with the current key and the number of packets which failed
+ * decryption, so that the limits carry over.  Because of the
+ * secrets, the snapshot must be protected as well as the TLS keys
+ * themselves.  The congestion controller state is not included, and
+ * the new connection starts over from the initial congestion window.
+ *
+ * The snapshot does not identify the negotiated cipher suite because
+ * the AEAD, the message digest, and the header protection cipher in
+ * :type:`ngtcp2_crypto_ctx` are process local objects.  The
+ * application must save the TLS cipher suite (e.g., 0x1301 for
+ * TLS_AES_128_GCM_SHA256, which is obtained by
+ * ``SSL_CIPHER_get_protocol_id(SSL_get_current_cipher(ssl))`` with
+ * OpenSSL) along with the snapshot.
+ *
+ * The snapshot can only be taken if the handshake has been confirmed,
+ * the keys have not been updated, and there is no data which might
+ * have to be sent again: all sent packets are acknowledged, no frame
+ * or datagram is queued, no path validation or Path MTU Discovery is
+ * in progress, and every stream has its sent data acknowledged and no
+ * out of order data buffered.  The received packets which have not
+ * been acknowledged yet are not acknowledged by the new connection,
+ * and the remote endpoint will send their contents again.  After
+ * taking the snapshot, |conn| should be deleted without sending any
+ * packet.
  *
- * |destlen| should be at least
- * :member:`ngtcp2_settings.max_udp_payload_size`.
+ * This function returns the number of bytes written if it succeeds,
+ * or one of the following negative error codes:
  *
- * For |path| and |pi| parameters, refer to
- * `ngtcp2_conn_writev_stream`.
+ * :macro:`NGTCP2_ERR_INVALID_STATE`
+ *     |conn| is not in the state that the snapshot can be taken.
+ * :macro:`NGTCP2_ERR_NOBUF`
+ *     The buffer is too small.
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
+ */
+NGTCP2_EXTERN ngtcp2_ssize ngtcp2_conn_encode_snapshot(ngtcp2_conn *conn,
+                                                       uint8_t *dest,
+                                                       size_t destlen);
+
+/**
+ * @function
  *
- * If the given data is written to the buffer, nonzero value is
- * assigned to |*paccepted| if it is not NULL.  The data in DATAGRAM
- * frame cannot be fragmented; writing partial data is not possible.
+ * `ngtcp2_conn_decode_and_set_snapshot` decodes the snapshot produced
+ * by `ngtcp2_conn_encode_snapshot` in the buffer pointed by |data| of
+ * length |datalen|, and restores the state of the connection into
+ * |conn|.  |conn| must be created by `ngtcp2_conn_server_new` or
+ * `ngtcp2_conn_client_new` as the endpoint of the same role with the
+ * same local transport parameters, and the same original Source
+ * Connection ID, and no packet must have been sent or received by it.
+ * |ts| is the current timestamp.
+ *
+ * Before calling this function, the application must rebuild
+ * :type:`ngtcp2_crypto_ctx` for the cipher suite saved along with the
+ * snapshot with `ngtcp2_crypto_ctx_cipher_suite`, and set it with
+ * `ngtcp2_conn_set_crypto_ctx`.  This function fails if the AEAD
+ * overhead and the AEAD limits of the crypto context differ from the
+ * ones recorded in the snapshot.
+ *
+ * The packet protection keys are not restored by this function.  On
+ * success, |*rx_secret| and |*tx_secret| point to the 1RTT secrets
+ * inside |data|, and the application must install the 1RTT keys
+ * derived from them before |conn| sends or receives a packet.
+ * `ngtcp2_crypto_derive_and_install_rx_key` and
+ * `ngtcp2_crypto_derive_and_install_tx_key` with
+ * :enum:`ngtcp2_crypto_level.NGTCP2_CRYPTO_LEVEL_APPLICATION` use the
+ * crypto context set above, and do not need a TLS session.  The
+ * restored streams have no stream user data; set it with
+ * `ngtcp2_conn_set_stream_user_data` if needed.
+ *
+ * If this function fails, |conn| is left in an undefined state, and
+ * it must be deleted.
  *
- * |dgram_id| is an opaque identifier which should uniquely identify
- * the given DATAGRAM.  It is passed to :type:`ngtcp2_ack_datagram`
- * callback when a packet that contains DATAGRAM frame is
- * acknowledged.  It is passed to :type:`ngtcp2_lost_datagram`
- * callback when a packet that contains DATAGRAM frame is declared
- * lost.  If an application uses neither of those callbacks, it can
- * sets 0 to this parameter.
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
  *
- * This function might write other frames other than DATAGRAM, just
- * like `ngtcp2_conn_writev_stream`.
+ * :macro:`NGTCP2_ERR_INVALID_STATE`
+ *     |conn| has already sent or received a packet.
+ * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     The snapshot is malformed, it was taken by the endpoint of the
+ *     other role, or the crypto context does not match.
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_decode_and_set_snapshot(
+    ngtcp2_conn *conn, ngtcp2_vec *rx_secret, ngtcp2_vec *tx_secret,
+    const uint8_t *data, size_t datalen, ngtcp2_tstamp ts);
+
+/**
+ * @function
  *
- * If the function returns 0, it means that no more data cannot be
- * sent because of congestion control limit; or, data does not fit
- * into the provided buffer; or, a local endpoint, as a server, is
- * unable to send data because of its amplification limit.  In this
- * case, |*paccepted| is assigned zero if it is not NULL.
+ * `ngtcp2_shared_pool_new` creates :type:`ngtcp2_shared_pool`, and
+ * assigns its pointer to |*ppool|.  The pool keeps at most
+ * |max_cached| released objects of each kind for reuse, and frees the
+ * others, so that the memory it holds tracks the aggregate load of
+ * the connections rather than the sum of their peaks.  Pass the pool
+ * to :member:`ngtcp2_settings.shared_pool`.  |mem| is the memory
+ * allocator for the pool and its objects.  If |mem| is ``NULL``, the
+ * default memory allocator is used.
  *
- * If :macro:`NGTCP2_WRITE_DATAGRAM_FLAG_MORE` is set in |flags|,
- * there are 3 outcomes:
+ * The objects in the pool are not counted by
+ * `ngtcp2_conn_get_mem_stat`.
  *
- * - The function returns the written length of packet just like
- *   without :macro:`NGTCP2_WRITE_DATAGRAM_FLAG_MORE`.  This is
- *   because packet is nearly full and the library decided to make a
- *   complete packet.  |*paccepted| might be zero or nonzero.
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
  *
- * - The function returns :macro:`NGTCP2_ERR_WRITE_MORE`.  In this
- *   case, |*paccepted| != 0 is asserted.  This indicates that
- *   application can call this function with another unreliable data
- *   (or `ngtcp2_conn_writev_stream` if it has stream data to send) to
- *   pack them into the same packet.  Application has to specify the
- *   same |conn|, |path|, |pi|, |dest|, |destlen|, and |ts|
- *   parameters, otherwise the behaviour is undefined.  The
- *   application can change |flags|.
+ * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     |max_cached| is 0.
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
+ */
+NGTCP2_EXTERN int ngtcp2_shared_pool_new(ngtcp2_shared_pool **ppool,
+                                         size_t max_cached,
+                                         const ngtcp2_mem *mem);
+
+/**
+ * @function
  *
- * - The other error might be returned just like without
- *   :macro:`NGTCP2_WRITE_DATAGRAM_FLAG_MORE`.
+ * `ngtcp2_shared_pool_del` frees |pool|.  All connections which use
+ * |pool| must be deleted before calling this function.  If |pool| is
+ * ``NULL``, this function does nothing.
+ */
+NGTCP2_EXTERN void ngtcp2_shared_pool_del(ngtcp2_shared_pool *pool);
+
+/**
+ * @function
  *
- * When application sees :macro:`NGTCP2_ERR_WRITE_MORE`, it must not
- * call other ngtcp2 API functions (application can still call
- * `ngtcp2_conn_write_connection_close` to handle error from this
- * function).  Just keep calling `ngtcp2_conn_writev_datagram`,
- * `ngtcp2_conn_writev_stream` or `ngtcp2_conn_write_pkt` until it
- * returns a positive number (which indicates a complete packet is
- * ready).
+ * `ngtcp2_shared_pool_trim` frees all released objects that |pool|
+ * keeps for reuse.
+ */
+NGTCP2_EXTERN void ngtcp2_shared_pool_trim(ngtcp2_shared_pool *pool);
+
+/**
+ * @function
  *
- * This function returns the number of bytes written in |dest| if it
- * succeeds, or one of the following negative error codes:
+ * `ngtcp2_shared_pool_get_stat` assigns the statistics of |pool| to
+ * |*stat|.
+ */
+NGTCP2_EXTERN void
+ngtcp2_shared_pool_get_stat_versioned(const ngtcp2_shared_pool *pool,
+                                      int shared_pool_stat_version,
+                                      ngtcp2_shared_pool_stat *stat);
+
+/**
+ * @struct
  *
- * :macro:`NGTCP2_ERR_NOMEM`
- *     Out of memory
- * :macro:`NGTCP2_ERR_PKT_NUM_EXHAUSTED`
- *     Packet number is exhausted, and cannot send any more packet.
- * :macro:`NGTCP2_ERR_CALLBACK_FAILURE`
- *     User callback failed
- * :macro:`NGTCP2_ERR_WRITE_MORE`
- *     (Only when :macro:`NGTCP2_WRITE_DATAGRAM_FLAG_MORE` is
- *     specified) Application can call this function to pack more data
- *     into the same packet.  See above to know how it works.
- * :macro:`NGTCP2_ERR_INVALID_STATE`
- *     A remote endpoint did not express the DATAGRAM frame support.
- * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
- *     The provisional DATAGRAM frame size exceeds the maximum
- *     DATAGRAM frame size that a remote endpoint can receive.
+ * :type:`ngtcp2_relay` is an opaque object which forwards the data
+ * received on a stream of one connection (the downstream) to a stream
+ * of another connection (the upstream).  It is created by
+ * `ngtcp2_relay_new`.
+ */
+typedef struct ngtcp2_relay ngtcp2_relay;
+
+/**
+ * @functypedef
  *
- * In general, if the error code which satisfies
- * `ngtcp2_err_is_fatal(err) <ngtcp2_err_is_fatal>` != 0 is returned,
- * the application should just close the connection by calling
- * `ngtcp2_conn_write_connection_close` or just delete the QUIC
- * connection using `ngtcp2_conn_del`.  It is undefined to call the
- * other library functions.
+ * :type:`ngtcp2_relay_rxbuf` is invoked when |relay| takes or drops a
+ * reference to |rxbuf| which is the application buffer passed to
+ * `ngtcp2_relay_recv_stream_data`.  |user_data| is the pointer passed
+ * to `ngtcp2_relay_new`.
  */
-NGTCP2_EXTERN ngtcp2_ssize ngtcp2_conn_writev_datagram_versioned(
-    ngtcp2_conn *conn, ngtcp2_path *path, int pkt_info_version,
-    ngtcp2_pkt_info *pi, uint8_t *dest, size_t destlen, int *paccepted,
-    uint32_t flags, uint64_t dgram_id, const ngtcp2_vec *datav, size_t datavcnt,
-    ngtcp2_tstamp ts);
+typedef void (*ngtcp2_relay_rxbuf)(ngtcp2_relay *relay, void *rxbuf,
+                                   void *user_data);
+
+/**
+ * @struct
+ *
+ * :type:`ngtcp2_relay_callbacks` holds the callback functions of
+ * :type:`ngtcp2_relay`.
+ */
+typedef struct ngtcp2_relay_callbacks {
+  /**
+   * :member:`ref_rxbuf` is called when |relay| refers to the stream
+   * data in an application buffer instead of copying it.  If it is
+   * NULL, |relay| always copies the stream data.
+   */
+  ngtcp2_relay_rxbuf ref_rxbuf;
+  /**
+   * :member:`unref_rxbuf` is called when |relay| no longer refers to
+   * the buffer passed to :member:`ref_rxbuf`.  It must be set if
+   * :member:`ref_rxbuf` is set.
+   */
+  ngtcp2_relay_rxbuf unref_rxbuf;
+} ngtcp2_relay_callbacks;
 
 /**
  * @function
  *
- * `ngtcp2_conn_is_in_closing_period` returns nonzero if |conn| is in
- * the closing period.
+ * `ngtcp2_relay_new` creates :type:`ngtcp2_relay` which forwards the
+ * data received on a stream denoted by |down_stream_id| of |down| to
+ * a stream denoted by |up_stream_id| of |up|, and assigns its pointer
+ * to |*prelay|.  |callbacks| and |user_data| are passed to the
+ * callback functions.  |mem| is the memory allocator.  If |mem| is
+ * ``NULL``, the default memory allocator is used.
+ *
+ * The relay owns all outgoing data of the upstream stream, and the
+ * application must not extend the flow control windows of |down| by
+ * the data that it passes to `ngtcp2_relay_recv_stream_data`.
+ * Instead, the relay extends them when the upstream acknowledges the
+ * data, so that a slow upstream keeps the downstream sender from
+ * running ahead of it.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     :member:`ngtcp2_relay_callbacks.ref_rxbuf` is set, and
+ *     :member:`ngtcp2_relay_callbacks.unref_rxbuf` is not.
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
  */
-NGTCP2_EXTERN int ngtcp2_conn_is_in_closing_period(ngtcp2_conn *conn);
+NGTCP2_EXTERN int ngtcp2_relay_new(ngtcp2_relay **prelay, ngtcp2_conn *down,
+                                   int64_t down_stream_id, ngtcp2_conn *up,
+                                   int64_t up_stream_id,
+                                   const ngtcp2_relay_callbacks *callbacks,
+                                   void *user_data, const ngtcp2_mem *mem);
 
 /**
  * @function
  *
- * `ngtcp2_conn_is_in_draining_period` returns nonzero if |conn| is in
- * the draining period.
+ * `ngtcp2_relay_del` frees |relay|, and drops the references to the
+ * application buffers that it still holds.  It must be called after
+ * the upstream stream is closed, or the upstream connection is
+ * deleted.  If |relay| is ``NULL``, this function does nothing.
  */
-NGTCP2_EXTERN int ngtcp2_conn_is_in_draining_period(ngtcp2_conn *conn);
+NGTCP2_EXTERN void ngtcp2_relay_del(ngtcp2_relay *relay);
 
 /**
  * @function
  *
- * `ngtcp2_conn_extend_max_stream_offset` extends stream's max stream
- * data value by |datalen|.
+ * `ngtcp2_relay_recv_stream_data` queues the stream data that the
+ * downstream connection passed to
+ * :member:`ngtcp2_callbacks.recv_stream_data`.  |flags|, |offset|,
+ * |data|, and |datalen| are the arguments of the callback.  |rxbuf|
+ * is the application buffer which was passed to `ngtcp2_conn_read_pkt`,
+ * or ``NULL``.
+ *
+ * If |flags| has :macro:`NGTCP2_STREAM_DATA_FLAG_IN_PLACE`, and
+ * |rxbuf| is not ``NULL``, |relay| takes a reference to |rxbuf| by
+ * :member:`ngtcp2_relay_callbacks.ref_rxbuf` and sends |data| without
+ * copying it.  Otherwise, |data| is copied.  The data loaned with
+ * :macro:`NGTCP2_STREAM_DATA_FLAG_LOANED` is released after it is
+ * copied.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
  *
  * :macro:`NGTCP2_ERR_NOMEM`
  *     Out of memory.
+ * :macro:`NGTCP2_ERR_STREAM_NOT_FOUND`
+ *     The upstream stream does not exist.
  */
-NGTCP2_EXTERN int ngtcp2_conn_extend_max_stream_offset(ngtcp2_conn *conn,
-                                                       int64_t stream_id,
-                                                       uint64_t datalen);
+NGTCP2_EXTERN int ngtcp2_relay_recv_stream_data(ngtcp2_relay *relay,
+                                                uint32_t flags,
+                                                uint64_t offset,
+                                                const uint8_t *data,
+                                                size_t datalen, void *rxbuf);
 
 /**
  * @function
  *
- * `ngtcp2_conn_extend_max_offset` extends max data offset by
- * |datalen|.
+ * `ngtcp2_relay_get_stream_data` assigns the queued data which has
+ * not been passed to `ngtcp2_conn_writev_stream` yet to |datav| of
+ * length |datavcnt|, and returns the number of elements assigned.
+ * |*pfin| is set to nonzero if the assigned data is the last data of
+ * the stream.  If `ngtcp2_conn_writev_stream` sets its |*pdatalen|
+ * to a nonnegative value for the upstream stream, the application
+ * must call `ngtcp2_relay_add_write_offset` with it.
  */
-NGTCP2_EXTERN void ngtcp2_conn_extend_max_offset(ngtcp2_conn *conn,
-                                                 uint64_t datalen);
+NGTCP2_EXTERN size_t ngtcp2_relay_get_stream_data(ngtcp2_relay *relay,
+                                                  ngtcp2_vec *datav,
+                                                  size_t datavcnt, int *pfin);
 
 /**
  * @function
  *
- * `ngtcp2_conn_extend_max_streams_bidi` extends the number of maximum
- * local bidirectional streams that a remote endpoint can open by |n|.
+ * `ngtcp2_relay_add_write_offset` tells |relay| that
+ * `ngtcp2_conn_writev_stream` has accepted |n| bytes of the data
+ * returned by `ngtcp2_relay_get_stream_data`, and the end of the
+ * stream if it was returned and all data have been accepted.
+ */
+NGTCP2_EXTERN void ngtcp2_relay_add_write_offset(ngtcp2_relay *relay,
+                                                 uint64_t n);
+
+/**
+ * @function
+ *
+ * `ngtcp2_relay_release_stream_buf` must be called from
+ * :member:`ngtcp2_callbacks.release_stream_buf` of the upstream
+ * connection with |buf_user_data| for the upstream stream.  The data
+ * which the upstream has finished with is freed, and the flow control
+ * windows of the downstream are extended by its length.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
  *
- * The library does not increase maximum stream limit automatically.
- * The exception is when a stream is closed without
- * :type:`ngtcp2_stream_open` callback being called.  In this case,
- * stream limit is increased automatically.
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
  */
-NGTCP2_EXTERN void ngtcp2_conn_extend_max_streams_bidi(ngtcp2_conn *conn,
-                                                       size_t n);
+NGTCP2_EXTERN int ngtcp2_relay_release_stream_buf(ngtcp2_relay *relay,
+                                                  void *buf_user_data);
 
 /**
  * @function
  *
- * `ngtcp2_conn_extend_max_streams_uni` extends the number of maximum
- * local unidirectional streams that a remote endpoint can open by
- * |n|.
+ * `ngtcp2_relay_detach_downstream` tells |relay| that the downstream
+ * connection is going away.  |relay| no longer extends its flow
+ * control windows.  The application must call this function before
+ * it deletes the downstream connection if |relay| outlives it.
+ */
+NGTCP2_EXTERN void ngtcp2_relay_detach_downstream(ngtcp2_relay *relay);
+
+/**
+ * @function
  *
- * The library does not increase maximum stream limit automatically.
- * The exception is when a stream is closed without
- * :type:`ngtcp2_stream_open` callback being called.  In this case,
- * stream limit is increased automatically.
+ * `ngtcp2_conn_get_perf_stat` assigns the CPU time that |conn| has
+ * spent in each processing phase to |*perf_stat|.  See
+ * :type:`ngtcp2_perf_stat` for how to enable it.
  */
-NGTCP2_EXTERN void ngtcp2_conn_extend_max_streams_uni(ngtcp2_conn *conn,
-                                                      size_t n);
+NGTCP2_EXTERN void
+ngtcp2_conn_get_perf_stat_versioned(ngtcp2_conn *conn, int perf_stat_version,
+                                    ngtcp2_perf_stat *perf_stat);
 
 /**
  * @function
  *
- * `ngtcp2_conn_get_dcid` returns the non-NULL pointer to destination
- * connection ID.  If no destination connection ID is present, the
- * return value is not ``NULL``, and its datalen field is 0.
+ * `ngtcp2_conn_get_stall_stat` assigns the time during which |conn|
+ * could not send packets, broken down by the reason, to
+ * |*stall_stat|.  See :type:`ngtcp2_stall_stat` for details.
  */
-NGTCP2_EXTERN const ngtcp2_cid *ngtcp2_conn_get_dcid(ngtcp2_conn *conn);
+NGTCP2_EXTERN void
+ngtcp2_conn_get_stall_stat_versioned(ngtcp2_conn *conn, int stall_stat_version,
+                                     ngtcp2_stall_stat *stall_stat);
 
 /**
  * @function
  *
- * `ngtcp2_conn_get_client_initial_dcid` returns the non-NULL pointer
- * to the Destination Connection ID that client sent in its Initial
- * packet.
+ * `ngtcp2_conn_get_latency_stat` assigns the latency histograms of
+ * |conn| to |*latency_stat|.  See :type:`ngtcp2_latency_stat` for how
+ * to enable them.
  */
-NGTCP2_EXTERN const ngtcp2_cid *
-ngtcp2_conn_get_client_initial_dcid(ngtcp2_conn *conn);
+NGTCP2_EXTERN void ngtcp2_conn_get_latency_stat_versioned(
+    ngtcp2_conn *conn, int latency_stat_version,
+    ngtcp2_latency_stat *latency_stat);
 
 /**
  * @function
  *
- * `ngtcp2_conn_get_num_scid` returns the number of source connection
- * IDs which the local endpoint has provided to the peer and have not
- * retired.
+ * `ngtcp2_conn_get_hol_stat` assigns the head-of-line blocking
+ * statistics of |conn|, which is the sum of those of all streams
+ * including the closed ones, to |*hol_stat|.
  */
-NGTCP2_EXTERN size_t ngtcp2_conn_get_num_scid(ngtcp2_conn *conn);
+NGTCP2_EXTERN void
+ngtcp2_conn_get_hol_stat_versioned(ngtcp2_conn *conn, int hol_stat_version,
+                                   ngtcp2_hol_stat *hol_stat);
 
 /**
  * @function
  *
- * `ngtcp2_conn_get_scid` writes the all source connection IDs which
- * the local endpoint has provided to the peer and have not retired in
- * |dest|.  The buffer pointed by |dest| must have
- * ``sizeof(ngtcp2_cid) * n`` bytes available, where n is the return
- * value of `ngtcp2_conn_get_num_scid()`.
+ * `ngtcp2_conn_get_stream_hol_stat` assigns the head-of-line
+ * blocking statistics of a stream identified by |stream_id| to
+ * |*hol_stat|.  It can be called inside
+ * :member:`ngtcp2_callbacks.stream_close` to get the final values of
+ * the stream.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_STREAM_NOT_FOUND`
+ *     Stream does not exist
  */
-NGTCP2_EXTERN size_t ngtcp2_conn_get_scid(ngtcp2_conn *conn, ngtcp2_cid *dest);
+NGTCP2_EXTERN int ngtcp2_conn_get_stream_hol_stat_versioned(
+    ngtcp2_conn *conn, int64_t stream_id, int hol_stat_version,
+    ngtcp2_hol_stat *hol_stat);
 
 /**
  * @function
  *
- * `ngtcp2_conn_get_num_active_dcid` returns the number of the active
- * destination connection ID.
+ * `ngtcp2_latency_hist_bucket_lower` returns the smallest duration
+ * in nanoseconds that falls into the bucket at |idx| of
+ * :type:`ngtcp2_latency_hist`.  The bucket covers the durations up to
+ * the lower bound of the next bucket, exclusive.  |idx| must be less
+ * than :macro:`NGTCP2_LATENCY_HIST_NBUCKET`.
  */
-NGTCP2_EXTERN size_t ngtcp2_conn_get_num_active_dcid(ngtcp2_conn *conn);
+NGTCP2_EXTERN ngtcp2_duration ngtcp2_latency_hist_bucket_lower(size_t idx);
 
 /**
- * @struct
+ * @function
  *
- * :type:`ngtcp2_cid_token` is the convenient struct to store
- * Connection ID, its associated path, and stateless reset token.
+ * `ngtcp2_latency_hist_percentile` returns the estimate of the
+ * |percentile| th percentile of |hist| in nanoseconds.  |percentile|
+ * must be in [0, 100], inclusive.  The estimate is the largest
+ * duration of the bucket which the percentile falls into, so that it
+ * is never lower than the actual value, but it never exceeds
+ * :member:`hist->max <ngtcp2_latency_hist.max>`.  It returns 0 if
+ * |hist| has no samples.
  */
-typedef struct ngtcp2_cid_token {
-  /**
-   * :member:`seq` is the sequence number of this Connection ID.
-   */
-  uint64_t seq;
-  /**
-   * :member:`cid` is Connection ID.
-   */
-  ngtcp2_cid cid;
-  /**
-   * :member:`ps` is the path which is associated to this Connection
-   * ID.
-   */
-  ngtcp2_path_storage ps;
-  /**
-   * :member:`token` is the stateless reset token for this Connection
-   * ID.
-   */
-  uint8_t token[NGTCP2_STATELESS_RESET_TOKENLEN];
-  /**
-   * :member:`token_present` is nonzero if token contains stateless
-   * reset token.
-   */
-  uint8_t token_present;
-} ngtcp2_cid_token;
+NGTCP2_EXTERN ngtcp2_duration
+ngtcp2_latency_hist_percentile(const ngtcp2_latency_hist *hist,
+                               double percentile);
 
 /**
  * @function
  *
- * `ngtcp2_conn_get_active_dcid` writes the all active destination
- * connection IDs and tokens to |dest|.  The buffer pointed by |dest|
- * must have ``sizeof(ngtcp2_cid_token) * n`` bytes available, where n
- * is the return value of `ngtcp2_conn_get_num_active_dcid()`.
+ * `ngtcp2_conn_get_cc_resume_params` assigns the congestion control
+ * state of the current path to |*params|, so that an application can
+ * give it to the next connection to the same remote endpoint through
+ * :member:`ngtcp2_settings.cc_resume`.  It is typically called just
+ * before a connection is closed.  If no RTT sample has been
+ * obtained, :member:`params->cwnd <ngtcp2_cc_resume_params.cwnd>` is
+ * 0.
  */
-NGTCP2_EXTERN size_t ngtcp2_conn_get_active_dcid(ngtcp2_conn *conn,
-                                                 ngtcp2_cid_token *dest);
+NGTCP2_EXTERN void
+ngtcp2_conn_get_cc_resume_params(ngtcp2_conn *conn,
+                                 ngtcp2_cc_resume_params *params);
+
+/**
+ * @macro
+ *
+ * :macro:`NGTCP2_MAX_CC_RESUME_PARAMSLEN` is the maximum length of
+ * :type:`ngtcp2_cc_resume_params` encoded by
+ * `ngtcp2_encode_cc_resume_params`.
+ */
+#define NGTCP2_MAX_CC_RESUME_PARAMSLEN 25
 
 /**
  * @function
  *
- * `ngtcp2_conn_get_client_chosen_version` returns the client chosen
- * version.
+ * `ngtcp2_encode_cc_resume_params` encodes |params| in |dest| of
+ * length |destlen| so that a server can carry it inside the opaque
+ * data of a token (see `ngtcp2_crypto_generate_regular_token2`), and
+ * restore it with `ngtcp2_decode_cc_resume_params` when the client
+ * comes back.  The encoded data never exceeds
+ * :macro:`NGTCP2_MAX_CC_RESUME_PARAMSLEN` bytes.
+ *
+ * This function returns the number of bytes written, or one of the
+ * following negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOBUF`
+ *     Buffer is too small.
  */
-NGTCP2_EXTERN uint32_t ngtcp2_conn_get_client_chosen_version(ngtcp2_conn *conn);
+NGTCP2_EXTERN ngtcp2_ssize
+ngtcp2_encode_cc_resume_params(uint8_t *dest, size_t destlen,
+                               const ngtcp2_cc_resume_params *params);
 
 /**
  * @function
  *
- * `ngtcp2_conn_get_negotiated_version` returns the negotiated version.
+ * `ngtcp2_decode_cc_resume_params` decodes |data| of length
+ * |datalen| produced by `ngtcp2_encode_cc_resume_params`, and stores
+ * the result in |*params|.  The decoded values are not checked
+ * against the current path; a connection validates them while
+ * resuming (see :member:`ngtcp2_settings.cc_resume`).
  *
- * Until the version is negotiated, this function returns 0.
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     |data| is malformed.
  */
-NGTCP2_EXTERN uint32_t ngtcp2_conn_get_negotiated_version(ngtcp2_conn *conn);
+NGTCP2_EXTERN int
+ngtcp2_decode_cc_resume_params(ngtcp2_cc_resume_params *params,
+                               const uint8_t *data, size_t datalen);
 
 /**
  * @function
  *
- * `ngtcp2_conn_early_data_rejected` tells |conn| that early data was
- * rejected by a server.  |conn| discards the following connection
- * states:
+ * `ngtcp2_conn_set_cc_callbacks` replaces the congestion controller
+ * chosen by :member:`ngtcp2_settings.cc_algo` with the one
+ * implemented by application.  |cc_callbacks| is copied.  This
+ * function must be called before |conn| writes the first packet.
+ * :member:`ngtcp2_cc_callbacks.reset` is called before this function
+ * returns.
  *
- * - Any opended streams.
- * - Stream identifier allocations.
- * - Max data extended by `ngtcp2_conn_extend_max_offset`.
- * - Max bidi streams extended by `ngtcp2_conn_extend_max_streams_bidi`.
- * - Max uni streams extended by `ngtcp2_conn_extend_max_streams_uni`.
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
  *
- * Application which wishes to retransmit early data, it has to open
- * streams and send stream data again.
+ * :macro:`NGTCP2_ERR_INVALID_STATE`
+ *     |conn| has already written a packet.
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
  */
-NGTCP2_EXTERN void ngtcp2_conn_early_data_rejected(ngtcp2_conn *conn);
+NGTCP2_EXTERN int
+ngtcp2_conn_set_cc_callbacks_versioned(ngtcp2_conn *conn,
+                                       int cc_callbacks_version,
+                                       const ngtcp2_cc_callbacks *cc_callbacks);
 
 /**
  * @function
  *
- * `ngtcp2_conn_get_conn_stat` assigns connection statistics data to
- * |*cstat|.
+ * `ngtcp2_log_record_print` renders |rec| into text, and calls
+ * |log_printf| with |user_data| for each line.  The output is
+ * identical to what :member:`ngtcp2_settings.log_printf` would
+ * receive.  It must be called inside :type:`ngtcp2_log_record_cb`
+ * which |rec| is passed to.
  */
-NGTCP2_EXTERN void ngtcp2_conn_get_conn_stat_versioned(ngtcp2_conn *conn,
-                                                       int conn_stat_version,
-                                                       ngtcp2_conn_stat *cstat);
+NGTCP2_EXTERN void ngtcp2_log_record_print(const ngtcp2_log_record *rec,
+                                           ngtcp2_printf log_printf,
+                                           void *user_data);
 
 /**
  * @function
@@ -4895,6 +8325,26 @@ NGTCP2_EXTERN void ngtcp2_conn_set_path_user_data(ngtcp2_conn *conn,
  */
 NGTCP2_EXTERN const ngtcp2_path *ngtcp2_conn_get_path(ngtcp2_conn *conn);
 
+/**
+ * @function
+ *
+ * `ngtcp2_conn_get_path_stat` assigns the statistics of the path
+ * which plays |role| to |*pstat|.  The active path always exists.
+ * The fallback path exists while the path which the remote endpoint
+ * migrated to is being validated, and the probing path exists while
+ * path validation is in progress.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_INVALID_ARGUMENT`
+ *     There is no path which plays |role|.
+ */
+NGTCP2_EXTERN int ngtcp2_conn_get_path_stat_versioned(ngtcp2_conn *conn,
+                                                      ngtcp2_path_role role,
+                                                      int path_stat_version,
+                                                      ngtcp2_path_stat *pstat);
+
 /**
  * @function
  *
@@ -5401,6 +8851,20 @@ NGTCP2_EXTERN int ngtcp2_conn_set_stream_user_data(ngtcp2_conn *conn,
 NGTCP2_EXTERN void ngtcp2_conn_update_pkt_tx_time(ngtcp2_conn *conn,
                                                   ngtcp2_tstamp ts);
 
+/**
+ * @function
+ *
+ * `ngtcp2_conn_get_pkt_tx_time` returns the earliest time at which
+ * the packets written next may leave the host, given the current
+ * time |ts|.  If packet pacing is disabled, or
+ * :member:`ngtcp2_settings.pacing_horizon` is 0, this function returns
+ * |ts|.  Call this function before writing a batch of packets, and
+ * pass the returned value to the kernel, for example with
+ * ``SCM_TXTIME``, when the batch is sent.
+ */
+NGTCP2_EXTERN ngtcp2_tstamp ngtcp2_conn_get_pkt_tx_time(ngtcp2_conn *conn,
+                                                        ngtcp2_tstamp ts);
+
 /**
  * @function
  *
@@ -5548,6 +9012,52 @@ ngtcp2_transport_params_default_versioned(int transport_params_version,
  */
 NGTCP2_EXTERN const ngtcp2_mem *ngtcp2_mem_default(void);
 
+/**
+ * @function
+ *
+ * `ngtcp2_thread_arena_new` creates :type:`ngtcp2_thread_arena`, and
+ * assigns its pointer to |*parena|.  The arena carves the allocations
+ * up to a few kilobytes out of large blocks obtained from |mem|, and
+ * keeps them in the free list of their size class when they are
+ * freed.  The larger allocations are passed through to |mem|.  If
+ * |mem| is ``NULL``, the memory allocator returned by
+ * `ngtcp2_mem_default()` is used.
+ *
+ * The arena is not synchronized, and it is not lock-free either: it
+ * must not be shared by threads.  It is intended for the model where
+ * each thread owns the connections it runs: create an arena per
+ * thread, and give `ngtcp2_thread_arena_get_mem()` to the connections
+ * on that thread only.  The memory must be freed by the same
+ * thread.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :macro:`NGTCP2_ERR_NOMEM`
+ *     Out of memory.
+ */
+NGTCP2_EXTERN int ngtcp2_thread_arena_new(ngtcp2_thread_arena **parena,
+                                          const ngtcp2_mem *mem);
+
+/**
+ * @function
+ *
+ * `ngtcp2_thread_arena_del` frees |arena| and all blocks it has
+ * obtained.  All memory allocated through |arena| must be freed
+ * before calling this function.  If |arena| is ``NULL``, this
+ * function does nothing.
+ */
+NGTCP2_EXTERN void ngtcp2_thread_arena_del(ngtcp2_thread_arena *arena);
+
+/**
+ * @function
+ *
+ * `ngtcp2_thread_arena_get_mem` returns :type:`ngtcp2_mem` which
+ * allocates memory from |arena|.  It is valid until |arena| is freed.
+ */
+NGTCP2_EXTERN const ngtcp2_mem *
+ngtcp2_thread_arena_get_mem(ngtcp2_thread_arena *arena);
+
 /**
  * @macrosection
  *
@@ -5672,6 +9182,15 @@ NGTCP2_EXTERN uint32_t ngtcp2_select_version(const uint32_t *preferred_versions,
   ngtcp2_conn_read_pkt_versioned((CONN), (PATH), NGTCP2_PKT_INFO_VERSION,      \
                                  (PI), (PKT), (PKTLEN), (TS))
 
+/*
+ * `ngtcp2_conn_read_pkts` is a wrapper around
+ * `ngtcp2_conn_read_pkts_versioned` to set the correct struct
+ * version.
+ */
+#define ngtcp2_conn_read_pkts(CONN, PATH, PI, PKT, PKTLEN, SEGSIZE, TS)        \
+  ngtcp2_conn_read_pkts_versioned((CONN), (PATH), NGTCP2_PKT_INFO_VERSION,     \
+                                  (PI), (PKT), (PKTLEN), (SEGSIZE), (TS))
+
 /*
  * `ngtcp2_conn_write_pkt` is a wrapper around
  * `ngtcp2_conn_write_pkt_versioned` to set the correct struct
@@ -5703,6 +9222,29 @@ NGTCP2_EXTERN uint32_t ngtcp2_select_version(const uint32_t *preferred_versions,
       (CONN), (PATH), NGTCP2_PKT_INFO_VERSION, (PI), (DEST), (DESTLEN),        \
       (PDATALEN), (FLAGS), (STREAM_ID), (DATAV), (DATAVCNT), (TS))
 
+/*
+ * `ngtcp2_conn_writev_streams` is a wrapper around
+ * `ngtcp2_conn_writev_streams_versioned` to set the correct struct
+ * version.
+ */
+#define ngtcp2_conn_writev_streams(CONN, PATH, PI, DEST, DESTLEN, PGSOLEN,     \
+                                   SW, SWCNT, TS)                              \
+  ngtcp2_conn_writev_streams_versioned((CONN), (PATH),                         \
+                                       NGTCP2_PKT_INFO_VERSION, (PI), (DEST),  \
+                                       (DESTLEN), (PGSOLEN), (SW), (SWCNT),    \
+                                       (TS))
+
+/*
+ * `ngtcp2_conn_write_burst` is a wrapper around
+ * `ngtcp2_conn_write_burst_versioned` to set the correct struct
+ * version.
+ */
+#define ngtcp2_conn_write_burst(CONN, PATH, PI, DEST, DESTLEN, MAX_PKTS,       \
+                                PGSOLEN, SW, SWCNT, TS)                        \
+  ngtcp2_conn_write_burst_versioned((CONN), (PATH), NGTCP2_PKT_INFO_VERSION,   \
+                                    (PI), (DEST), (DESTLEN), (MAX_PKTS),       \
+                                    (PGSOLEN), (SW), (SWCNT), (TS))
+
 /*
  * `ngtcp2_conn_writev_datagram` is a wrapper around
  * `ngtcp2_conn_writev_datagram_versioned` to set the correct struct
@@ -5725,6 +9267,15 @@ NGTCP2_EXTERN uint32_t ngtcp2_select_version(const uint32_t *preferred_versions,
       (CONN), (PATH), NGTCP2_PKT_INFO_VERSION, (PI), (DEST), (DESTLEN),        \
       (CCERR), (TS))
 
+/*
+ * `ngtcp2_conn_write_keep_alive` is a wrapper around
+ * `ngtcp2_conn_write_keep_alive_versioned` to set the correct struct
+ * version.
+ */
+#define ngtcp2_conn_write_keep_alive(CONN, PATH, PI, DEST, DESTLEN, TS)        \
+  ngtcp2_conn_write_keep_alive_versioned(                                      \
+      (CONN), (PATH), NGTCP2_PKT_INFO_VERSION, (PI), (DEST), (DESTLEN), (TS))
+
 /*
  * `ngtcp2_encode_transport_params` is a wrapper around
  * `ngtcp2_encode_transport_params_versioned` to set the correct
@@ -5802,6 +9353,94 @@ NGTCP2_EXTERN uint32_t ngtcp2_select_version(const uint32_t *preferred_versions,
 #define ngtcp2_conn_get_conn_stat(CONN, CSTAT)                                 \
   ngtcp2_conn_get_conn_stat_versioned((CONN), NGTCP2_CONN_STAT_VERSION, (CSTAT))
 
+/*
+ * `ngtcp2_conn_get_path_stat` is a wrapper around
+ * `ngtcp2_conn_get_path_stat_versioned` to set the correct struct
+ * version.
+ */
+#define ngtcp2_conn_get_path_stat(CONN, ROLE, PSTAT)                           \
+  ngtcp2_conn_get_path_stat_versioned((CONN), (ROLE),                          \
+                                      NGTCP2_PATH_STAT_VERSION, (PSTAT))
+
+/*
+ * `ngtcp2_conn_get_published_conn_stat` is a wrapper around
+ * `ngtcp2_conn_get_published_conn_stat_versioned` to set the correct
+ * struct version.
+ */
+#define ngtcp2_conn_get_published_conn_stat(CONN, CSTAT)                       \
+  ngtcp2_conn_get_published_conn_stat_versioned(                               \
+      (CONN), NGTCP2_CONN_STAT_VERSION, (CSTAT))
+
+/*
+ * `ngtcp2_conn_get_mem_stat` is a wrapper around
+ * `ngtcp2_conn_get_mem_stat_versioned` to set the correct struct
+ * version.
+ */
+#define ngtcp2_conn_get_mem_stat(CONN, MSTAT)                                  \
+  ngtcp2_conn_get_mem_stat_versioned((CONN), NGTCP2_MEM_STAT_VERSION, (MSTAT))
+
+/*
+ * `ngtcp2_shared_pool_get_stat` is a wrapper around
+ * `ngtcp2_shared_pool_get_stat_versioned` to set the correct struct
+ * version.
+ */
+#define ngtcp2_shared_pool_get_stat(POOL, STAT)                                \
+  ngtcp2_shared_pool_get_stat_versioned(                                       \
+      (POOL), NGTCP2_SHARED_POOL_STAT_VERSION, (STAT))
+
+/*
+ * `ngtcp2_conn_get_perf_stat` is a wrapper around
+ * `ngtcp2_conn_get_perf_stat_versioned` to set the correct struct
+ * version.
+ */
+#define ngtcp2_conn_get_perf_stat(CONN, PSTAT)                                 \
+  ngtcp2_conn_get_perf_stat_versioned((CONN), NGTCP2_PERF_STAT_VERSION,        \
+                                      (PSTAT))
+
+/*
+ * `ngtcp2_conn_get_stall_stat` is a wrapper around
+ * `ngtcp2_conn_get_stall_stat_versioned` to set the correct struct
+ * version.
+ */
+#define ngtcp2_conn_get_stall_stat(CONN, SSTAT)                                \
+  ngtcp2_conn_get_stall_stat_versioned((CONN), NGTCP2_STALL_STAT_VERSION,      \
+                                       (SSTAT))
+
+/*
+ * `ngtcp2_conn_get_latency_stat` is a wrapper around
+ * `ngtcp2_conn_get_latency_stat_versioned` to set the correct struct
+ * version.
+ */
+#define ngtcp2_conn_get_latency_stat(CONN, LSTAT)                              \
+  ngtcp2_conn_get_latency_stat_versioned((CONN), NGTCP2_LATENCY_STAT_VERSION,  \
+                                         (LSTAT))
+
+/*
+ * `ngtcp2_conn_get_hol_stat` is a wrapper around
+ * `ngtcp2_conn_get_hol_stat_versioned` to set the correct struct
+ * version.
+ */
+#define ngtcp2_conn_get_hol_stat(CONN, HSTAT)                                  \
+  ngtcp2_conn_get_hol_stat_versioned((CONN), NGTCP2_HOL_STAT_VERSION, (HSTAT))
+
+/*
+ * `ngtcp2_conn_get_stream_hol_stat` is a wrapper around
+ * `ngtcp2_conn_get_stream_hol_stat_versioned` to set the correct
+ * struct version.
+ */
+#define ngtcp2_conn_get_stream_hol_stat(CONN, STREAM_ID, HSTAT)                \
+  ngtcp2_conn_get_stream_hol_stat_versioned(                                   \
+      (CONN), (STREAM_ID), NGTCP2_HOL_STAT_VERSION, (HSTAT))
+
+/*
+ * `ngtcp2_conn_set_cc_callbacks` is a wrapper around
+ * `ngtcp2_conn_set_cc_callbacks_versioned` to set the correct struct
+ * version.
+ */
+#define ngtcp2_conn_set_cc_callbacks(CONN, CC_CALLBACKS)                       \
+  ngtcp2_conn_set_cc_callbacks_versioned(                                      \
+      (CONN), NGTCP2_CC_CALLBACKS_VERSION, (CC_CALLBACKS))
+
 /*
  * `ngtcp2_settings_default` is a wrapper around
  * `ngtcp2_settings_default_versioned` to set the correct struct
@@ -28,153 +28,218 @@
 
 #include "ngtcp2_macro.h"
 
-static void acktr_entry_init(ngtcp2_acktr_entry *ent, int64_t pkt_num,
-                             ngtcp2_tstamp tstamp) {
-  ent->pkt_num = pkt_num;
-  ent->len = 1;
-  ent->tstamp = tstamp;
-}
-
-int ngtcp2_acktr_entry_objalloc_new(ngtcp2_acktr_entry **ent, int64_t pkt_num,
-                                    ngtcp2_tstamp tstamp,
-                                    ngtcp2_objalloc *objalloc) {
-  *ent = ngtcp2_objalloc_acktr_entry_get(objalloc);
-  if (*ent == NULL) {
-    return NGTCP2_ERR_NOMEM;
-  }
-
-  acktr_entry_init(*ent, pkt_num, tstamp);
-
-  return 0;
-}
-
-void ngtcp2_acktr_entry_objalloc_del(ngtcp2_acktr_entry *ent,
-                                     ngtcp2_objalloc *objalloc) {
-  ngtcp2_objalloc_acktr_entry_release(objalloc, ent);
-}
-
-static int greater(const ngtcp2_ksl_key *lhs, const ngtcp2_ksl_key *rhs) {
-  return *(int64_t *)lhs > *(int64_t *)rhs;
-}
-
 int ngtcp2_acktr_init(ngtcp2_acktr *acktr, ngtcp2_log *log,
                       const ngtcp2_mem *mem) {
   int rv;
 
-  ngtcp2_objalloc_acktr_entry_init(&acktr->objalloc, 32, mem);
-
   rv = ngtcp2_ringbuf_init(&acktr->acks, 32, sizeof(ngtcp2_acktr_ack_entry),
                            mem);
   if (rv != 0) {
     return rv;
   }
 
-  ngtcp2_ksl_init(&acktr->ents, greater, sizeof(int64_t), mem);
+  rv = ngtcp2_ringbuf_init(&acktr->ents, NGTCP2_ACKTR_INITIAL_ENT,
+                           sizeof(ngtcp2_acktr_entry), mem);
+  if (rv != 0) {
+    ngtcp2_ringbuf_free(&acktr->acks);
+    return rv;
+  }
 
   acktr->log = log;
   acktr->mem = mem;
   acktr->flags = NGTCP2_ACKTR_FLAG_NONE;
   acktr->first_unacked_ts = UINT64_MAX;
   acktr->rx_npkt = 0;
+  acktr->gen = 0;
 
   return 0;
 }
 
 void ngtcp2_acktr_free(ngtcp2_acktr *acktr) {
-#ifdef NOMEMPOOL
-  ngtcp2_ksl_it it;
-#endif /* NOMEMPOOL */
-
   if (acktr == NULL) {
     return;
   }
 
-#ifdef NOMEMPOOL
-  for (it = ngtcp2_ksl_begin(&acktr->ents); !ngtcp2_ksl_it_end(&it);
-       ngtcp2_ksl_it_next(&it)) {
-    ngtcp2_acktr_entry_objalloc_del(ngtcp2_ksl_it_get(&it), &acktr->objalloc);
+  ngtcp2_ringbuf_free(&acktr->ents);
+
+  ngtcp2_ringbuf_free(&acktr->acks);
+}
+
+ngtcp2_acktr_entry *ngtcp2_acktr_get(ngtcp2_acktr *acktr, size_t idx) {
+  return ngtcp2_ringbuf_get(&acktr->ents, idx);
+}
+
+size_t ngtcp2_acktr_len(ngtcp2_acktr *acktr) {
+  return ngtcp2_ringbuf_len(&acktr->ents);
+}
+
+/*
+ * acktr_lower_bound returns the index of the first entry whose
+ * pkt_num is less than or equal to |pkt_num|.  If there is no such
+ * entry, it returns the number of entries.
+ */
+static size_t acktr_lower_bound(ngtcp2_acktr *acktr, int64_t pkt_num) {
+  size_t lo = 0, hi = ngtcp2_ringbuf_len(&acktr->ents), mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (ngtcp2_acktr_get(acktr, mid)->pkt_num <= pkt_num) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
   }
-#endif /* NOMEMPOOL */
 
-  ngtcp2_ksl_free(&acktr->ents);
+  return lo;
+}
 
-  ngtcp2_ringbuf_free(&acktr->acks);
+/*
+ * acktr_insert makes room for a new entry at |idx|, and assigns the
+ * pointer to it to |*pent|.  If |acktr| is full, the entry which has
+ * the smallest packet number is evicted.  If that is the new entry
+ * itself, NULL is assigned to |*pent|.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ */
+static int acktr_insert(ngtcp2_acktr *acktr, ngtcp2_acktr_entry **pent,
+                        size_t idx) {
+  ngtcp2_ringbuf *rb = &acktr->ents;
+  size_t len = ngtcp2_ringbuf_len(rb), i;
+  int rv;
+
+  if (ngtcp2_ringbuf_full(rb)) {
+    if (rb->nmemb < NGTCP2_ACKTR_MAX_ENT) {
+      rv = ngtcp2_ringbuf_reserve(rb, rb->nmemb * 2);
+      if (rv != 0) {
+        return rv;
+      }
+    } else {
+      if (idx == len) {
+        *pent = NULL;
+        return 0;
+      }
+
+      ngtcp2_ringbuf_pop_back(rb);
+      --len;
+    }
+  }
+
+  if (idx < len / 2) {
+    ngtcp2_ringbuf_push_front(rb);
+
+    for (i = 0; i < idx; ++i) {
+      *ngtcp2_acktr_get(acktr, i) = *ngtcp2_acktr_get(acktr, i + 1);
+    }
+  } else {
+    ngtcp2_ringbuf_push_back(rb);
+
+    for (i = len; i > idx; --i) {
+      *ngtcp2_acktr_get(acktr, i) = *ngtcp2_acktr_get(acktr, i - 1);
+    }
+  }
+
+  *pent = ngtcp2_acktr_get(acktr, idx);
+
+  return 0;
+}
+
+/*
+ * acktr_remove removes the entry at |idx|.
+ */
+static void acktr_remove(ngtcp2_acktr *acktr, size_t idx) {
+  ngtcp2_ringbuf *rb = &acktr->ents;
+  size_t len = ngtcp2_ringbuf_len(rb), i;
+
+  if (idx < len / 2) {
+    for (i = idx; i > 0; --i) {
+      *ngtcp2_acktr_get(acktr, i) = *ngtcp2_acktr_get(acktr, i - 1);
+    }
+
+    ngtcp2_ringbuf_pop_front(rb);
+
+    return;
+  }
+
+  for (i = idx; i + 1 < len; ++i) {
+    *ngtcp2_acktr_get(acktr, i) = *ngtcp2_acktr_get(acktr, i + 1);
+  }
 
-  ngtcp2_objalloc_free(&acktr->objalloc);
+  ngtcp2_ringbuf_pop_back(rb);
 }
 
 int ngtcp2_acktr_add(ngtcp2_acktr *acktr, int64_t pkt_num, int active_ack,
                      ngtcp2_tstamp ts) {
-  ngtcp2_ksl_it it, prev_it;
-  ngtcp2_acktr_entry *ent, *prev_ent, *delent;
+  ngtcp2_acktr_entry *ent, *prev_ent;
+  size_t idx = 0;
   int rv;
-  int added = 0;
 
-  if (ngtcp2_ksl_len(&acktr->ents)) {
-    it = ngtcp2_ksl_lower_bound(&acktr->ents, &pkt_num);
-    if (ngtcp2_ksl_it_end(&it)) {
-      ngtcp2_ksl_it_prev(&it);
-      ent = ngtcp2_ksl_it_get(&it);
+  if (ngtcp2_ringbuf_len(&acktr->ents)) {
+    ent = ngtcp2_acktr_get(acktr, 0);
 
-      assert(ent->pkt_num >= pkt_num + (int64_t)ent->len);
+    assert(ent->pkt_num != pkt_num);
 
-      if (ent->pkt_num == pkt_num + (int64_t)ent->len) {
+    if (ent->pkt_num < pkt_num) {
+      /* Fast path: packets usually arrive in order, and extend the
+         range of the largest packet number. */
+      if (ent->pkt_num + 1 == pkt_num) {
+        ent->pkt_num = pkt_num;
+        ent->tstamp = ts;
         ++ent->len;
-        added = 1;
+        goto fin;
       }
     } else {
-      ent = ngtcp2_ksl_it_get(&it);
+      idx = acktr_lower_bound(acktr, pkt_num);
 
-      assert(ent->pkt_num != pkt_num);
+      assert(idx > 0);
 
-      if (ngtcp2_ksl_it_begin(&it)) {
-        if (ent->pkt_num + 1 == pkt_num) {
-          ngtcp2_ksl_update_key(&acktr->ents, &ent->pkt_num, &pkt_num);
-          ent->pkt_num = pkt_num;
-          ent->tstamp = ts;
-          ++ent->len;
-          added = 1;
-        }
-      } else {
-        prev_it = it;
-        ngtcp2_ksl_it_prev(&prev_it);
-        prev_ent = ngtcp2_ksl_it_get(&prev_it);
+      prev_ent = ngtcp2_acktr_get(acktr, idx - 1);
 
-        assert(prev_ent->pkt_num >= pkt_num + (int64_t)prev_ent->len);
+      assert(prev_ent->pkt_num >= pkt_num + (int64_t)prev_ent->len);
+
+      ++acktr->gen;
+
+      if (idx < ngtcp2_ringbuf_len(&acktr->ents)) {
+        ent = ngtcp2_acktr_get(acktr, idx);
 
         if (ent->pkt_num + 1 == pkt_num) {
           if (prev_ent->pkt_num == pkt_num + (int64_t)prev_ent->len) {
             prev_ent->len += ent->len + 1;
-            ngtcp2_ksl_remove_hint(&acktr->ents, NULL, &it, &ent->pkt_num);
-            ngtcp2_acktr_entry_objalloc_del(ent, &acktr->objalloc);
-            added = 1;
+            acktr_remove(acktr, idx);
           } else {
-            ngtcp2_ksl_update_key(&acktr->ents, &ent->pkt_num, &pkt_num);
             ent->pkt_num = pkt_num;
             ent->tstamp = ts;
             ++ent->len;
-            added = 1;
           }
-        } else if (prev_ent->pkt_num == pkt_num + (int64_t)prev_ent->len) {
-          ++prev_ent->len;
-          added = 1;
+
+          goto fin;
         }
       }
+
+      if (prev_ent->pkt_num == pkt_num + (int64_t)prev_ent->len) {
+        ++prev_ent->len;
+        goto fin;
+      }
     }
   }
 
-  if (!added) {
-    rv = ngtcp2_acktr_entry_objalloc_new(&ent, pkt_num, ts, &acktr->objalloc);
-    if (rv != 0) {
-      return rv;
-    }
-    rv = ngtcp2_ksl_insert(&acktr->ents, NULL, &ent->pkt_num, ent);
-    if (rv != 0) {
-      ngtcp2_acktr_entry_objalloc_del(ent, &acktr->objalloc);
-      return rv;
-    }
+  ++acktr->gen;
+
+  rv = acktr_insert(acktr, &ent, idx);
+  if (rv != 0) {
+    return rv;
+  }
+
+  if (ent) {
+    ent->pkt_num = pkt_num;
+    ent->len = 1;
+    ent->tstamp = ts;
   }
 
+fin:
   if (active_ack) {
     acktr->flags |= NGTCP2_ACKTR_FLAG_ACTIVE_ACK;
     if (acktr->first_unacked_ts == UINT64_MAX) {
@@ -182,37 +247,17 @@ int ngtcp2_acktr_add(ngtcp2_acktr *acktr, int64_t pkt_num, int active_ack,
     }
   }
 
-  if (ngtcp2_ksl_len(&acktr->ents) > NGTCP2_ACKTR_MAX_ENT) {
-    it = ngtcp2_ksl_end(&acktr->ents);
-    ngtcp2_ksl_it_prev(&it);
-    delent = ngtcp2_ksl_it_get(&it);
-    ngtcp2_ksl_remove_hint(&acktr->ents, NULL, &it, &delent->pkt_num);
-    ngtcp2_acktr_entry_objalloc_del(delent, &acktr->objalloc);
-  }
-
   return 0;
 }
 
-void ngtcp2_acktr_forget(ngtcp2_acktr *acktr, ngtcp2_acktr_entry *ent) {
-  ngtcp2_ksl_it it;
-
-  it = ngtcp2_ksl_lower_bound(&acktr->ents, &ent->pkt_num);
-  assert(*(int64_t *)ngtcp2_ksl_it_key(&it) == (int64_t)ent->pkt_num);
+void ngtcp2_acktr_forget(ngtcp2_acktr *acktr, size_t idx) {
+  ++acktr->gen;
 
-  for (; !ngtcp2_ksl_it_end(&it);) {
-    ent = ngtcp2_ksl_it_get(&it);
-    ngtcp2_ksl_remove_hint(&acktr->ents, &it, &it, &ent->pkt_num);
-    ngtcp2_acktr_entry_objalloc_del(ent, &acktr->objalloc);
-  }
-}
-
-ngtcp2_ksl_it ngtcp2_acktr_get(ngtcp2_acktr *acktr) {
-  return ngtcp2_ksl_begin(&acktr->ents);
+  ngtcp2_ringbuf_resize(&acktr->ents, idx);
 }
 
 int ngtcp2_acktr_empty(ngtcp2_acktr *acktr) {
-  ngtcp2_ksl_it it = ngtcp2_ksl_begin(&acktr->ents);
-  return ngtcp2_ksl_it_end(&it);
+  return ngtcp2_ringbuf_len(&acktr->ents) == 0;
 }
 
 ngtcp2_acktr_ack_entry *ngtcp2_acktr_add_ack(ngtcp2_acktr *acktr,
@@ -226,39 +271,24 @@ ngtcp2_acktr_ack_entry *ngtcp2_acktr_add_ack(ngtcp2_acktr *acktr,
   return ent;
 }
 
-/*
- * acktr_remove removes |ent| from |acktr|.  |it| must point to the
- * node whose key identifies |ent|.  The iterator which points to the
- * entry next to |ent| is assigned to |it|.
- */
-static void acktr_remove(ngtcp2_acktr *acktr, ngtcp2_ksl_it *it,
-                         ngtcp2_acktr_entry *ent) {
-  ngtcp2_ksl_remove_hint(&acktr->ents, it, it, &ent->pkt_num);
-  ngtcp2_acktr_entry_objalloc_del(ent, &acktr->objalloc);
-}
-
 static void acktr_on_ack(ngtcp2_acktr *acktr, ngtcp2_ringbuf *rb,
                          size_t ack_ent_offset) {
   ngtcp2_acktr_ack_entry *ack_ent;
   ngtcp2_acktr_entry *ent;
-  ngtcp2_ksl_it it;
+  size_t idx;
 
   assert(ngtcp2_ringbuf_len(rb));
 
   ack_ent = ngtcp2_ringbuf_get(rb, ack_ent_offset);
 
-  /* Assume that ngtcp2_pkt_validate_ack(fr) returns 0 */
-  it = ngtcp2_ksl_lower_bound(&acktr->ents, &ack_ent->largest_ack);
-  for (; !ngtcp2_ksl_it_end(&it);) {
-    ent = ngtcp2_ksl_it_get(&it);
-    acktr_remove(acktr, &it, ent);
-  }
+  ++acktr->gen;
 
-  if (ngtcp2_ksl_len(&acktr->ents)) {
-    assert(ngtcp2_ksl_it_end(&it));
+  /* Assume that ngtcp2_pkt_validate_ack(fr) returns 0 */
+  idx = acktr_lower_bound(acktr, ack_ent->largest_ack);
+  ngtcp2_ringbuf_resize(&acktr->ents, idx);
 
-    ngtcp2_ksl_it_prev(&it);
-    ent = ngtcp2_ksl_it_get(&it);
+  if (idx) {
+    ent = ngtcp2_acktr_get(acktr, idx - 1);
     if (ent->pkt_num > ack_ent->largest_ack &&
         ack_ent->largest_ack >= ent->pkt_num - (int64_t)(ent->len - 1)) {
       ent->len = (size_t)(ent->pkt_num - ack_ent->largest_ack);
@@ -271,9 +301,11 @@ static void acktr_on_ack(ngtcp2_acktr *acktr, ngtcp2_ringbuf *rb,
 void ngtcp2_acktr_recv_ack(ngtcp2_acktr *acktr, const ngtcp2_ack *fr) {
   ngtcp2_acktr_ack_entry *ent;
   int64_t largest_ack = fr->largest_ack, min_ack;
-  size_t i, j;
+  size_t j;
   ngtcp2_ringbuf *rb = &acktr->acks;
   size_t nacks = ngtcp2_ringbuf_len(rb);
+  ngtcp2_ack_range_it it;
+  ngtcp2_ack_blk blk;
 
   /* Assume that ngtcp2_pkt_validate_ack(fr) returns 0 */
   for (j = 0; j < nacks; ++j) {
@@ -293,9 +325,11 @@ void ngtcp2_acktr_recv_ack(ngtcp2_acktr *acktr, const ngtcp2_ack *fr) {
     return;
   }
 
-  for (i = 0; i < fr->num_blks && j < nacks; ++i) {
-    largest_ack = min_ack - (int64_t)fr->blks[i].gap - 2;
-    min_ack = largest_ack - (int64_t)fr->blks[i].blklen;
+  ngtcp2_ack_range_it_init(&it, fr);
+
+  while (j < nacks && ngtcp2_ack_range_it_next(&it, &blk)) {
+    largest_ack = min_ack - (int64_t)blk.gap - 2;
+    min_ack = largest_ack - (int64_t)blk.blklen;
 
     for (;;) {
       if (ent->pkt_num > largest_ack) {
@@ -33,13 +33,24 @@
 
 #include "ngtcp2_mem.h"
 #include "ngtcp2_ringbuf.h"
-#include "ngtcp2_ksl.h"
 #include "ngtcp2_pkt.h"
-#include "ngtcp2_objalloc.h"
 
 /* NGTCP2_ACKTR_MAX_ENT is the maximum number of ngtcp2_acktr_entry
    which ngtcp2_acktr stores. */
-#define NGTCP2_ACKTR_MAX_ENT 1024
+#ifndef LOWMEMORY
+#  define NGTCP2_ACKTR_MAX_ENT 1024
+#else /* LOWMEMORY */
+#  define NGTCP2_ACKTR_MAX_ENT 128
+#endif /* LOWMEMORY */
+
+/* NGTCP2_ACKTR_INITIAL_ENT is the initial capacity of
+   ngtcp2_acktr.ents.  It is doubled as needed up to
+   NGTCP2_ACKTR_MAX_ENT. */
+#ifndef LOWMEMORY
+#  define NGTCP2_ACKTR_INITIAL_ENT 8
+#else /* LOWMEMORY */
+#  define NGTCP2_ACKTR_INITIAL_ENT 4
+#endif /* LOWMEMORY */
 
 typedef struct ngtcp2_log ngtcp2_log;
 
@@ -47,48 +58,18 @@ typedef struct ngtcp2_log ngtcp2_log;
  * ngtcp2_acktr_entry is a range of packets which need to be acked.
  */
 typedef struct ngtcp2_acktr_entry {
-  union {
-    struct {
-      /* pkt_num is the largest packet number to acknowledge in this
-         range. */
-      int64_t pkt_num;
-      /* len is the consecutive packets started from pkt_num which
-         includes pkt_num itself counting in decreasing order.  So pkt_num
-         = 987 and len = 2, this entry includes packet 987 and 986. */
-      size_t len;
-      /* tstamp is the timestamp when a packet denoted by pkt_num is
-         received. */
-      ngtcp2_tstamp tstamp;
-    };
-
-    ngtcp2_opl_entry oplent;
-  };
+  /* pkt_num is the largest packet number to acknowledge in this
+     range. */
+  int64_t pkt_num;
+  /* len is the consecutive packets started from pkt_num which
+     includes pkt_num itself counting in decreasing order.  So pkt_num
+     = 987 and len = 2, this entry includes packet 987 and 986. */
+  size_t len;
+  /* tstamp is the timestamp when a packet denoted by pkt_num is
+     received. */
+  ngtcp2_tstamp tstamp;
 } ngtcp2_acktr_entry;
 
-ngtcp2_objalloc_def(acktr_entry, ngtcp2_acktr_entry, oplent);
-
-/*
- * ngtcp2_acktr_entry_objalloc_new allocates memory for ent, and
- * initializes it with the given parameters.  The pointer to the
- * allocated object is stored to |*ent|.
- *
- * This function returns 0 if it succeeds, or one of the following
- * negative error codes:
- *
- * NGTCP2_ERR_NOMEM
- *     Out of memory.
- */
-int ngtcp2_acktr_entry_objalloc_new(ngtcp2_acktr_entry **ent, int64_t pkt_num,
-                                    ngtcp2_tstamp tstamp,
-                                    ngtcp2_objalloc *objalloc);
-
-/*
- * ngtcp2_acktr_entry_objalloc_del deallocates memory allocated for
- * |ent|.
- */
-void ngtcp2_acktr_entry_objalloc_del(ngtcp2_acktr_entry *ent,
-                                     ngtcp2_objalloc *objalloc);
-
 typedef struct ngtcp2_acktr_ack_entry {
   /* largest_ack is the largest packet number in outgoing ACK frame */
   int64_t largest_ack;
@@ -112,11 +93,11 @@ typedef struct ngtcp2_acktr_ack_entry {
  * ngtcp2_acktr tracks received packets which we have to send ack.
  */
 typedef struct ngtcp2_acktr {
-  ngtcp2_objalloc objalloc;
   ngtcp2_ringbuf acks;
   /* ents includes ngtcp2_acktr_entry sorted by decreasing order of
-     packet number. */
-  ngtcp2_ksl ents;
+     packet number.  In-order packets just extend the first entry,
+     and the oldest entry is evicted from the back. */
+  ngtcp2_ringbuf ents;
   ngtcp2_log *log;
   const ngtcp2_mem *mem;
   /* flags is bitwise OR of zero, or more of NGTCP2_ACKTR_FLAG_*. */
@@ -126,6 +107,11 @@ typedef struct ngtcp2_acktr {
   ngtcp2_tstamp first_unacked_ts;
   /* rx_npkt is the number of packets received without sending ACK. */
   size_t rx_npkt;
+  /* gen is incremented whenever ents is modified, except when the
+     range of the largest packet number is extended upward by one.
+     It lets a caller tell whether ACK blocks built from ents other
+     than the first one are still current. */
+  uint64_t gen;
 } ngtcp2_acktr;
 
 /*
@@ -162,18 +148,22 @@ int ngtcp2_acktr_add(ngtcp2_acktr *acktr, int64_t pkt_num, int active_ack,
                      ngtcp2_tstamp ts);
 
 /*
- * ngtcp2_acktr_forget removes all entries which have the packet
- * number that is equal to or less than ent->pkt_num.  This function
- * assumes that |acktr| includes |ent|.
+ * ngtcp2_acktr_forget removes the |idx|-th entry and all entries
+ * after it.  |idx| must be less than ngtcp2_acktr_len(acktr).
+ */
+void ngtcp2_acktr_forget(ngtcp2_acktr *acktr, size_t idx);
+
+/*
+ * ngtcp2_acktr_get returns the |idx|-th entry counting from the one
+ * which has the largest packet number to be acked.  |idx| must be
+ * less than ngtcp2_acktr_len(acktr).
  */
-void ngtcp2_acktr_forget(ngtcp2_acktr *acktr, ngtcp2_acktr_entry *ent);
+ngtcp2_acktr_entry *ngtcp2_acktr_get(ngtcp2_acktr *acktr, size_t idx);
 
 /*
- * ngtcp2_acktr_get returns the pointer to pointer to the entry which
- * has the largest packet number to be acked.  If there is no entry,
- * returned value satisfies ngtcp2_ksl_it_end(&it) != 0.
+ * ngtcp2_acktr_len returns the number of entries in |acktr|.
  */
-ngtcp2_ksl_it ngtcp2_acktr_get(ngtcp2_acktr *acktr);
+size_t ngtcp2_acktr_len(ngtcp2_acktr *acktr);
 
 /*
  * ngtcp2_acktr_empty returns nonzero if it has no packet to
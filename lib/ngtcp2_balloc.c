@@ -32,7 +32,7 @@ void ngtcp2_balloc_init(ngtcp2_balloc *balloc, size_t blklen,
                         const ngtcp2_mem *mem) {
   assert((blklen & 0xfu) == 0);
 
-  balloc->mem = mem;
+  balloc->mem = ngtcp2_mem_for_subsys(mem, NGTCP2_MEM_SUBSYS_BALLOC);
   balloc->blklen = blklen;
   balloc->head = NULL;
   ngtcp2_buf_init(&balloc->buf, (void *)"", 0);
@@ -41,6 +41,10 @@ static const double pacing_gain_cycle[] = {1.25, 0.75, 1, 1, 1, 1, 1, 1};
 #define NGTCP2_BBR_PROBE_RTT_DURATION (200 * NGTCP2_MILLISECONDS)
 #define NGTCP2_RTPROP_FILTERLEN (10 * NGTCP2_SECONDS)
 #define NGTCP2_BBR_BTL_BW_FILTERLEN 10
+/* NGTCP2_BBR_SECONDS_RECIP is the reciprocal of NGTCP2_SECONDS.  The
+   rates in bytes per second are multiplied by it rather than divided
+   by NGTCP2_SECONDS on every ACK. */
+#define NGTCP2_BBR_SECONDS_RECIP (1. / NGTCP2_SECONDS)
 
 static void bbr_update_on_ack(ngtcp2_bbr_cc *cc, ngtcp2_conn_stat *cstat,
                               const ngtcp2_cc_ack *ack, ngtcp2_tstamp ts);
@@ -357,7 +361,7 @@ static void bbr_init_pacing_rate(ngtcp2_bbr_cc *cc, ngtcp2_conn_stat *cstat) {
 static void bbr_set_pacing_rate_with_gain(ngtcp2_bbr_cc *cc,
                                           ngtcp2_conn_stat *cstat,
                                           double pacing_gain) {
-  double rate = pacing_gain * (double)cc->btl_bw / NGTCP2_SECONDS;
+  double rate = pacing_gain * (double)cc->btl_bw * NGTCP2_BBR_SECONDS_RECIP;
 
   if (cc->filled_pipe || rate > cstat->pacing_rate) {
     cstat->pacing_rate = rate;
@@ -398,7 +402,8 @@ static uint64_t bbr_inflight(ngtcp2_bbr_cc *cc, ngtcp2_conn_stat *cstat,
     return cc->initial_cwnd;
   }
 
-  estimated_bdp = (double)cc->btl_bw * (double)cc->rt_prop / NGTCP2_SECONDS;
+  estimated_bdp = (double)cc->btl_bw * (double)cc->rt_prop *
+                  NGTCP2_BBR_SECONDS_RECIP;
 
   return (uint64_t)(gain * estimated_bdp) + quanta;
 }
@@ -25,6 +25,7 @@
 #include "ngtcp2_bbr2.h"
 
 #include <assert.h>
+#include <string.h>
 
 #include "ngtcp2_log.h"
 #include "ngtcp2_macro.h"
@@ -58,12 +59,23 @@
 
 #define NGTCP2_BBR_PACING_MARGIN_PERCENT 1
 
+/* NGTCP2_BBR_PACING_RATE_SCALE converts the bandwidth in bytes per
+   second to the pacing rate in bytes per nanosecond with
+   NGTCP2_BBR_PACING_MARGIN_PERCENT applied.  It is folded into a
+   single constant so that the pacing rate is computed without
+   division on every ACK. */
+#define NGTCP2_BBR_PACING_RATE_SCALE                                           \
+  ((double)(100 - NGTCP2_BBR_PACING_MARGIN_PERCENT) / 100 / NGTCP2_SECONDS)
+
 static void bbr_on_init(ngtcp2_bbr2_cc *bbr, ngtcp2_conn_stat *cstat,
                         ngtcp2_tstamp initial_ts);
 
 static void bbr_on_transmit(ngtcp2_bbr2_cc *bbr, ngtcp2_conn_stat *cstat,
                             ngtcp2_tstamp ts);
 
+static void bbr_update_stat(ngtcp2_bbr2_cc *bbr, ngtcp2_conn_stat *cstat,
+                            ngtcp2_tstamp ts);
+
 static void bbr_reset_congestion_signals(ngtcp2_bbr2_cc *bbr);
 
 static void bbr_reset_lower_bounds(ngtcp2_bbr2_cc *bbr);
@@ -341,6 +353,8 @@ static void bbr_on_init(ngtcp2_bbr2_cc *bbr, ngtcp2_conn_stat *cstat,
   bbr->prior_inflight_lo = 0;
   bbr->prior_inflight_hi = 0;
   bbr->prior_bw_lo = 0;
+
+  bbr_update_stat(bbr, cstat, initial_ts);
 }
 
 static void bbr_reset_congestion_signals(ngtcp2_bbr2_cc *bbr) {
@@ -414,8 +428,7 @@ static void bbr_init_pacing_rate(ngtcp2_bbr2_cc *bbr, ngtcp2_conn_stat *cstat) {
 static void bbr_set_pacing_rate_with_gain(ngtcp2_bbr2_cc *bbr,
                                           ngtcp2_conn_stat *cstat,
                                           double pacing_gain) {
-  double rate = pacing_gain * (double)bbr->bw *
-                (100 - NGTCP2_BBR_PACING_MARGIN_PERCENT) / 100 / NGTCP2_SECONDS;
+  double rate = pacing_gain * (double)bbr->bw * NGTCP2_BBR_PACING_RATE_SCALE;
 
   if (bbr->filled_pipe || rate > cstat->pacing_rate) {
     cstat->pacing_rate = rate;
@@ -426,10 +439,39 @@ static void bbr_set_pacing_rate(ngtcp2_bbr2_cc *bbr, ngtcp2_conn_stat *cstat) {
   bbr_set_pacing_rate_with_gain(bbr, cstat, bbr->pacing_gain);
 }
 
+static void bbr_set_state(ngtcp2_bbr2_cc *bbr, ngtcp2_bbr2_state state) {
+  bbr->state = state;
+  ++bbr->state_count[state];
+}
+
+/*
+ * bbr_update_stat exports the telemetry of |bbr| to |cstat|.  The
+ * time since the last call is accounted to the state which was
+ * exported by the last call, because the state changes only when the
+ * congestion controller is called.
+ */
+static void bbr_update_stat(ngtcp2_bbr2_cc *bbr, ngtcp2_conn_stat *cstat,
+                            ngtcp2_tstamp ts) {
+  if (cstat->bbr2_state != NGTCP2_BBR2_STATE_NONE && ts > bbr->stat_ts) {
+    cstat->bbr2_state_time[cstat->bbr2_state] += ts - bbr->stat_ts;
+  }
+
+  bbr->stat_ts = ts;
+
+  cstat->bbr2_state = bbr->state;
+  memcpy(cstat->bbr2_state_count, bbr->state_count,
+         sizeof(cstat->bbr2_state_count));
+  cstat->bbr2_max_bw = bbr->max_bw;
+  cstat->bbr2_bw_lo = bbr->bw_lo;
+  cstat->bbr2_inflight_hi = bbr->inflight_hi;
+  cstat->bbr2_inflight_lo = bbr->inflight_lo;
+  cstat->bbr2_inflight_too_high_count = bbr->inflight_too_high_count;
+}
+
 static void bbr_enter_startup(ngtcp2_bbr2_cc *bbr) {
   ngtcp2_log_info(bbr->ccb.log, NGTCP2_LOG_EVENT_RCV, "bbr2 enter Startup");
 
-  bbr->state = NGTCP2_BBR2_STATE_STARTUP;
+  bbr_set_state(bbr, NGTCP2_BBR2_STATE_STARTUP);
   bbr->pacing_gain = NGTCP2_BBR_STARTUP_PACING_GAIN;
   bbr->cwnd_gain = NGTCP2_BBR_STARTUP_CWND_GAIN;
 }
@@ -640,7 +682,7 @@ static void bbr_update_ack_aggregation(ngtcp2_bbr2_cc *bbr,
 static void bbr_enter_drain(ngtcp2_bbr2_cc *bbr) {
   ngtcp2_log_info(bbr->ccb.log, NGTCP2_LOG_EVENT_RCV, "bbr2 enter Drain");
 
-  bbr->state = NGTCP2_BBR2_STATE_DRAIN;
+  bbr_set_state(bbr, NGTCP2_BBR2_STATE_DRAIN);
   bbr->pacing_gain = 1. / NGTCP2_BBR_STARTUP_CWND_GAIN;
   bbr->cwnd_gain = NGTCP2_BBR_STARTUP_CWND_GAIN;
 }
@@ -672,7 +714,7 @@ static void bbr_start_probe_bw_down(ngtcp2_bbr2_cc *bbr, ngtcp2_tstamp ts) {
 
   bbr_start_round(bbr);
 
-  bbr->state = NGTCP2_BBR2_STATE_PROBE_BW_DOWN;
+  bbr_set_state(bbr, NGTCP2_BBR2_STATE_PROBE_BW_DOWN);
   bbr->pacing_gain = 0.9;
   bbr->cwnd_gain = 2;
 }
@@ -681,7 +723,7 @@ static void bbr_start_probe_bw_cruise(ngtcp2_bbr2_cc *bbr) {
   ngtcp2_log_info(bbr->ccb.log, NGTCP2_LOG_EVENT_RCV,
                   "bbr2 start ProbeBW_CRUISE");
 
-  bbr->state = NGTCP2_BBR2_STATE_PROBE_BW_CRUISE;
+  bbr_set_state(bbr, NGTCP2_BBR2_STATE_PROBE_BW_CRUISE);
   bbr->pacing_gain = 1.0;
   bbr->cwnd_gain = 2;
 }
@@ -698,7 +740,7 @@ static void bbr_start_probe_bw_refill(ngtcp2_bbr2_cc *bbr) {
 
   bbr_start_round(bbr);
 
-  bbr->state = NGTCP2_BBR2_STATE_PROBE_BW_REFILL;
+  bbr_set_state(bbr, NGTCP2_BBR2_STATE_PROBE_BW_REFILL);
   bbr->pacing_gain = 1.0;
   bbr->cwnd_gain = 2;
 }
@@ -712,7 +754,7 @@ static void bbr_start_probe_bw_up(ngtcp2_bbr2_cc *bbr, ngtcp2_conn_stat *cstat,
   bbr_start_round(bbr);
 
   bbr->cycle_stamp = ts;
-  bbr->state = NGTCP2_BBR2_STATE_PROBE_BW_UP;
+  bbr_set_state(bbr, NGTCP2_BBR2_STATE_PROBE_BW_UP);
   bbr->pacing_gain = 1.25;
   bbr->cwnd_gain = 2;
 
@@ -832,7 +874,13 @@ static void bbr_probe_inflight_hi_upward(ngtcp2_bbr2_cc *bbr,
   bbr->bw_probe_up_acks += ack->bytes_delivered;
 
   if (bbr->bw_probe_up_acks >= bbr->probe_up_cnt) {
-    delta = bbr->bw_probe_up_acks / bbr->probe_up_cnt;
+    /* An ACK rarely delivers more than probe_up_cnt bytes.  Avoid
+       division in that case. */
+    if (bbr->bw_probe_up_acks < 2 * bbr->probe_up_cnt) {
+      delta = 1;
+    } else {
+      delta = bbr->bw_probe_up_acks / bbr->probe_up_cnt;
+    }
     bbr->bw_probe_up_acks -= delta * bbr->probe_up_cnt;
     bbr->inflight_hi += delta * cstat->max_udp_payload_size;
   }
@@ -940,6 +988,8 @@ static void bbr_handle_inflight_too_high(ngtcp2_bbr2_cc *bbr,
                                          ngtcp2_conn_stat *cstat,
                                          const ngtcp2_rs *rs,
                                          ngtcp2_tstamp ts) {
+  ++bbr->inflight_too_high_count;
+
   bbr->bw_probe_samples = 0;
 
   if (!rs->is_app_limited) {
@@ -1049,7 +1099,7 @@ static void bbr_check_probe_rtt(ngtcp2_bbr2_cc *bbr, ngtcp2_conn_stat *cstat,
 static void bbr_enter_probe_rtt(ngtcp2_bbr2_cc *bbr) {
   ngtcp2_log_info(bbr->ccb.log, NGTCP2_LOG_EVENT_RCV, "bbr2 enter ProbeRTT");
 
-  bbr->state = NGTCP2_BBR2_STATE_PROBE_RTT;
+  bbr_set_state(bbr, NGTCP2_BBR2_STATE_PROBE_RTT);
   bbr->pacing_gain = 1;
   bbr->cwnd_gain = NGTCP2_BBR_PROBE_RTT_CWND_GAIN;
 }
@@ -1360,6 +1410,7 @@ static void bbr2_cc_on_pkt_lost(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
   ngtcp2_bbr2_cc *bbr = ngtcp2_struct_of(ccx->ccb, ngtcp2_bbr2_cc, ccb);
 
   bbr_update_on_loss(bbr, cstat, pkt, ts);
+  bbr_update_stat(bbr, cstat, ts);
 }
 
 static void bbr2_cc_congestion_event(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
@@ -1418,6 +1469,7 @@ static void bbr2_cc_on_ack_recv(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
   ngtcp2_bbr2_cc *bbr = ngtcp2_struct_of(ccx->ccb, ngtcp2_bbr2_cc, ccb);
 
   bbr_update_on_ack(bbr, cstat, ack, ts);
+  bbr_update_stat(bbr, cstat, ts);
 }
 
 static void bbr2_cc_on_pkt_sent(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
@@ -1425,6 +1477,7 @@ static void bbr2_cc_on_pkt_sent(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
   ngtcp2_bbr2_cc *bbr = ngtcp2_struct_of(ccx->ccb, ngtcp2_bbr2_cc, ccb);
 
   bbr_on_transmit(bbr, cstat, pkt->sent_ts);
+  bbr_update_stat(bbr, cstat, pkt->sent_ts);
 }
 
 static void bbr2_cc_new_rtt_sample(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
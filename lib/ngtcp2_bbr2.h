@@ -36,16 +36,6 @@
 
 typedef struct ngtcp2_rst ngtcp2_rst;
 
-typedef enum ngtcp2_bbr2_state {
-  NGTCP2_BBR2_STATE_STARTUP,
-  NGTCP2_BBR2_STATE_DRAIN,
-  NGTCP2_BBR2_STATE_PROBE_BW_DOWN,
-  NGTCP2_BBR2_STATE_PROBE_BW_CRUISE,
-  NGTCP2_BBR2_STATE_PROBE_BW_REFILL,
-  NGTCP2_BBR2_STATE_PROBE_BW_UP,
-  NGTCP2_BBR2_STATE_PROBE_RTT,
-} ngtcp2_bbr2_state;
-
 typedef enum ngtcp2_bbr2_ack_phase {
   NGTCP2_BBR2_ACK_PHASE_ACKS_PROBE_STARTING,
   NGTCP2_BBR2_ACK_PHASE_ACKS_PROBE_STOPPING,
@@ -136,6 +126,13 @@ typedef struct ngtcp2_bbr2_cc {
   uint64_t prior_inflight_lo;
   uint64_t prior_inflight_hi;
   uint64_t prior_bw_lo;
+
+  /* Telemetry exported to ngtcp2_conn_stat */
+  /* state_count is the number of times each state was entered. */
+  uint64_t state_count[NGTCP2_BBR2_STATE_MAX];
+  uint64_t inflight_too_high_count;
+  /* stat_ts is the time when ngtcp2_conn_stat was last updated. */
+  ngtcp2_tstamp stat_ts;
 } ngtcp2_bbr2_cc;
 
 int ngtcp2_cc_bbr2_cc_init(ngtcp2_cc *cc, ngtcp2_log *log,
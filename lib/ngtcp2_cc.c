@@ -25,11 +25,13 @@
 #include "ngtcp2_cc.h"
 
 #include <assert.h>
+#include <string.h>
 
 #if defined(_MSC_VER)
 #  include <intrin.h>
 #endif
 
+#include "ngtcp2_conn.h"
 #include "ngtcp2_log.h"
 #include "ngtcp2_macro.h"
 #include "ngtcp2_mem.h"
@@ -56,21 +58,316 @@ ngtcp2_cc_pkt *ngtcp2_cc_pkt_init(ngtcp2_cc_pkt *pkt, int64_t pkt_num,
   return pkt;
 }
 
+/* HyStart++ constants */
+#define NGTCP2_HS_MIN_SSTHRESH 16
+#define NGTCP2_HS_N_RTT_SAMPLE 8
+#define NGTCP2_HS_MIN_ETA (4 * NGTCP2_MILLISECONDS)
+#define NGTCP2_HS_MAX_ETA (16 * NGTCP2_MILLISECONDS)
+#define NGTCP2_HS_CSS_GROWTH_DIVISOR 4
+#define NGTCP2_HS_CSS_ROUNDS 5
+
+static void hs_reset(ngtcp2_hs *hs) {
+  hs->rtt_sample_count = 0;
+  hs->current_round_min_rtt = UINT64_MAX;
+  hs->last_round_min_rtt = UINT64_MAX;
+  hs->window_end = -1;
+  hs->css_baseline_min_rtt = UINT64_MAX;
+  hs->css_round = 0;
+  hs->pending_add = 0;
+}
+
+static void hs_init(ngtcp2_hs *hs, int enabled) {
+  hs->enabled = enabled;
+  hs_reset(hs);
+}
+
+/*
+ * hs_on_pkt_sent starts a new round when |pkt| is sent, unless a
+ * round is in progress.
+ */
+static void hs_on_pkt_sent(ngtcp2_hs *hs, const ngtcp2_cc_pkt *pkt) {
+  if (pkt->pktns_id != NGTCP2_PKTNS_ID_APPLICATION || hs->window_end != -1) {
+    return;
+  }
+
+  hs->window_end = pkt->pkt_num;
+  hs->last_round_min_rtt = hs->current_round_min_rtt;
+  hs->current_round_min_rtt = UINT64_MAX;
+  hs->rtt_sample_count = 0;
+}
+
+static void hs_new_rtt_sample(ngtcp2_hs *hs, const ngtcp2_conn_stat *cstat) {
+  if (hs->window_end == -1) {
+    return;
+  }
+
+  hs->current_round_min_rtt =
+      ngtcp2_min(hs->current_round_min_rtt, cstat->latest_rtt);
+  ++hs->rtt_sample_count;
+}
+
+/*
+ * hs_on_pkt_acked ends the current round if |pkt| is the last packet
+ * of it.
+ */
+static void hs_on_pkt_acked(ngtcp2_hs *hs, const ngtcp2_cc_pkt *pkt) {
+  if (pkt->pktns_id != NGTCP2_PKTNS_ID_APPLICATION || hs->window_end == -1 ||
+      hs->window_end > pkt->pkt_num) {
+    return;
+  }
+
+  hs->window_end = -1;
+
+  if (hs->css_baseline_min_rtt != UINT64_MAX) {
+    ++hs->css_round;
+  }
+}
+
+/*
+ * cc_ss_exit records that the initial slow start ended for |reason|.
+ */
+static void cc_ss_exit(ngtcp2_conn_stat *cstat, ngtcp2_ss_exit_reason reason,
+                       ngtcp2_tstamp ts) {
+  if (cstat->ss_exit_reason != NGTCP2_SS_EXIT_REASON_NONE) {
+    return;
+  }
+
+  cstat->ss_exit_reason = reason;
+  cstat->ss_exit_ts = ts;
+  cstat->ss_exit_cwnd = cstat->cwnd;
+}
+
+/*
+ * hs_on_congestion_event should be called when a congestion event
+ * occurs, before cwnd is reduced.
+ */
+static void hs_on_congestion_event(ngtcp2_hs *hs, ngtcp2_conn_stat *cstat,
+                                   ngtcp2_tstamp ts) {
+  if (cstat->cwnd < cstat->ssthresh) {
+    cc_ss_exit(cstat, NGTCP2_SS_EXIT_REASON_LOSS, ts);
+  }
+
+  hs->css_baseline_min_rtt = UINT64_MAX;
+}
+
+/*
+ * hs_slow_start increases cwnd for |pkt| which is acknowledged in
+ * slow start.  HyStart++ is only used in the initial slow start.  It
+ * returns nonzero if HyStart++ ends slow start, in which case
+ * ssthresh is set to cwnd.
+ */
+static int hs_slow_start(ngtcp2_hs *hs, ngtcp2_conn_stat *cstat,
+                         const ngtcp2_cc_pkt *pkt, ngtcp2_log *log,
+                         ngtcp2_tstamp ts) {
+  ngtcp2_duration eta;
+  uint64_t m;
+
+  if (!hs->enabled || cstat->ssthresh != UINT64_MAX ||
+      hs->css_baseline_min_rtt == UINT64_MAX) {
+    cstat->cwnd += pkt->pktlen;
+
+    ngtcp2_log_info(log, NGTCP2_LOG_EVENT_RCV,
+                    "pkn=%" PRId64 " acked, slow start cwnd=%" PRIu64,
+                    pkt->pkt_num, cstat->cwnd);
+
+    if (!hs->enabled || cstat->ssthresh != UINT64_MAX ||
+        hs->last_round_min_rtt == UINT64_MAX ||
+        hs->current_round_min_rtt == UINT64_MAX ||
+        cstat->cwnd < NGTCP2_HS_MIN_SSTHRESH * cstat->max_udp_payload_size ||
+        hs->rtt_sample_count < NGTCP2_HS_N_RTT_SAMPLE) {
+      return 0;
+    }
+
+    eta = hs->last_round_min_rtt / 8;
+
+    if (eta < NGTCP2_HS_MIN_ETA) {
+      eta = NGTCP2_HS_MIN_ETA;
+    } else if (eta > NGTCP2_HS_MAX_ETA) {
+      eta = NGTCP2_HS_MAX_ETA;
+    }
+
+    if (hs->current_round_min_rtt >= hs->last_round_min_rtt + eta) {
+      hs->css_baseline_min_rtt = hs->current_round_min_rtt;
+      hs->css_round = 0;
+      hs->pending_add = 0;
+
+      ++cstat->hystart_css_count;
+
+      ngtcp2_log_info(log, NGTCP2_LOG_EVENT_RCV,
+                      "HyStart++ enter conservative slow start "
+                      "css_baseline_min_rtt=%" PRIu64,
+                      hs->css_baseline_min_rtt);
+    }
+
+    return 0;
+  }
+
+  /* Conservative Slow Start */
+  m = hs->pending_add + pkt->pktlen;
+  cstat->cwnd += m / NGTCP2_HS_CSS_GROWTH_DIVISOR;
+  hs->pending_add = m % NGTCP2_HS_CSS_GROWTH_DIVISOR;
+
+  ngtcp2_log_info(log, NGTCP2_LOG_EVENT_RCV,
+                  "pkn=%" PRId64
+                  " acked, conservative slow start cwnd=%" PRIu64,
+                  pkt->pkt_num, cstat->cwnd);
+
+  if (hs->rtt_sample_count >= NGTCP2_HS_N_RTT_SAMPLE &&
+      hs->current_round_min_rtt < hs->css_baseline_min_rtt) {
+    hs->css_baseline_min_rtt = UINT64_MAX;
+
+    ++cstat->hystart_css_spurious_count;
+
+    ngtcp2_log_info(log, NGTCP2_LOG_EVENT_RCV, "HyStart++ resume slow start");
+
+    return 0;
+  }
+
+  if (hs->css_round < NGTCP2_HS_CSS_ROUNDS) {
+    return 0;
+  }
+
+  hs->css_baseline_min_rtt = UINT64_MAX;
+
+  cc_ss_exit(cstat, NGTCP2_SS_EXIT_REASON_HYSTART, ts);
+  cstat->ssthresh = cstat->cwnd;
+
+  ngtcp2_log_info(log, NGTCP2_LOG_EVENT_RCV,
+                  "HyStart++ exit slow start cwnd=%" PRIu64, cstat->cwnd);
+
+  return 1;
+}
+
+/* NGTCP2_CWV_MIN_PERIOD is the minimum duration of pipeACK sampling
+   period. */
+#define NGTCP2_CWV_MIN_PERIOD NGTCP2_SECONDS
+
+static void cwv_reset(ngtcp2_cwv *cwv) {
+  cwv->pipeack = 0;
+  cwv->prev_pipeack = 0;
+  cwv->period_ts = UINT64_MAX;
+}
+
+static void cwv_init(ngtcp2_cwv *cwv, int enabled) {
+  cwv->enabled = enabled;
+  cwv->burst_limited = 0;
+  cwv_reset(cwv);
+}
+
+/*
+ * cwv_update_period starts a new sampling period if the current one
+ * has ended at |ts|.  The sampling period is max(3 * smoothed_rtt, 1
+ * second) as RFC 7661 recommends.
+ */
+static void cwv_update_period(ngtcp2_cwv *cwv, const ngtcp2_conn_stat *cstat,
+                              ngtcp2_tstamp ts) {
+  ngtcp2_duration period =
+      ngtcp2_max(3 * cstat->smoothed_rtt, NGTCP2_CWV_MIN_PERIOD);
+
+  if (cwv->period_ts != UINT64_MAX && cwv->period_ts + period > ts) {
+    return;
+  }
+
+  /* If the current period ended more than a period ago, nothing
+     has been acknowledged since then, and its pipeACK is stale. */
+  if (cwv->period_ts != UINT64_MAX && cwv->period_ts + 2 * period > ts) {
+    cwv->prev_pipeack = cwv->pipeack;
+  } else {
+    cwv->prev_pipeack = 0;
+  }
+
+  cwv->pipeack = 0;
+  cwv->period_ts = ts;
+}
+
+static void cwv_on_pkt_acked(ngtcp2_cwv *cwv, const ngtcp2_conn_stat *cstat,
+                             const ngtcp2_cc_pkt *pkt, ngtcp2_tstamp ts) {
+  if (!cwv->enabled) {
+    return;
+  }
+
+  cwv_update_period(cwv, cstat, ts);
+
+  cwv->pipeack = ngtcp2_max(cwv->pipeack, pkt->tx_in_flight);
+}
+
+/*
+ * cwv_validated returns nonzero if the congestion window is
+ * validated, that is pipeACK is at least the half of it.  pipeACK is
+ * undefined until the first packet is acknowledged, and the initial
+ * window is always validated.
+ */
+static int cwv_validated(const ngtcp2_cwv *cwv,
+                         const ngtcp2_conn_stat *cstat) {
+  return cwv->period_ts == UINT64_MAX ||
+         cstat->cwnd <=
+             ngtcp2_cc_compute_initcwnd(cstat->max_udp_payload_size) ||
+         2 * ngtcp2_max(cwv->pipeack, cwv->prev_pipeack) >= cstat->cwnd;
+}
+
+/*
+ * cwv_limits_growth returns nonzero if the acknowledgement of |pkt|
+ * must not grow the congestion window.  It is only the case if |pkt|
+ * was sent while app-limited, and the congestion window is not
+ * validated.  While the sender is cwnd-limited, it grows as usual.
+ */
+static int cwv_limits_growth(const ngtcp2_cwv *cwv,
+                             const ngtcp2_conn_stat *cstat,
+                             const ngtcp2_cc_pkt *pkt) {
+  return cwv->enabled && pkt->is_app_limited && !cwv_validated(cwv, cstat);
+}
+
+/*
+ * cwv_limit_burst limits send_quantum to the initial window if the
+ * sender restarts from app-limited while the congestion window is
+ * not validated, so that it does not send the whole unused window in
+ * a single burst (RFC 9002, section 7.7).
+ */
+static void cwv_limit_burst(ngtcp2_cwv *cwv, ngtcp2_conn_stat *cstat) {
+  if (cwv_validated(cwv, cstat)) {
+    return;
+  }
+
+  cwv->burst_limited = 1;
+  cstat->send_quantum =
+      (size_t)ngtcp2_cc_compute_initcwnd(cstat->max_udp_payload_size);
+}
+
+/*
+ * cwv_update_burst_limit lifts the limit set by cwv_limit_burst once
+ * the congestion window is validated again.
+ */
+static void cwv_update_burst_limit(ngtcp2_cwv *cwv, ngtcp2_conn_stat *cstat) {
+  if (!cwv->burst_limited || !cwv_validated(cwv, cstat)) {
+    return;
+  }
+
+  cwv->burst_limited = 0;
+  cstat->send_quantum = SIZE_MAX;
+}
+
 static void reno_cc_reset(ngtcp2_reno_cc *cc) {
   cc->max_delivery_rate_sec = 0;
   cc->target_cwnd = 0;
   cc->pending_add = 0;
+  cc->prior.cwnd = 0;
+  cc->prior.ssthresh = 0;
+  hs_reset(&cc->hs);
+  cwv_reset(&cc->cwv);
 }
 
-void ngtcp2_reno_cc_init(ngtcp2_reno_cc *cc, ngtcp2_log *log) {
+void ngtcp2_reno_cc_init(ngtcp2_reno_cc *cc, ngtcp2_log *log, int hystart,
+                         int cwnd_validation) {
   cc->ccb.log = log;
+  hs_init(&cc->hs, hystart);
+  cwv_init(&cc->cwv, cwnd_validation);
   reno_cc_reset(cc);
 }
 
 void ngtcp2_reno_cc_free(ngtcp2_reno_cc *cc) { (void)cc; }
 
-int ngtcp2_cc_reno_cc_init(ngtcp2_cc *cc, ngtcp2_log *log,
-                           const ngtcp2_mem *mem) {
+int ngtcp2_cc_reno_cc_init(ngtcp2_cc *cc, ngtcp2_log *log, int hystart,
+                           int cwnd_validation, const ngtcp2_mem *mem) {
   ngtcp2_reno_cc *reno_cc;
 
   reno_cc = ngtcp2_mem_calloc(mem, 1, sizeof(ngtcp2_reno_cc));
@@ -78,14 +375,18 @@ int ngtcp2_cc_reno_cc_init(ngtcp2_cc *cc, ngtcp2_log *log,
     return NGTCP2_ERR_NOMEM;
   }
 
-  ngtcp2_reno_cc_init(reno_cc, log);
+  ngtcp2_reno_cc_init(reno_cc, log, hystart, cwnd_validation);
 
   cc->ccb = &reno_cc->ccb;
   cc->on_pkt_acked = ngtcp2_cc_reno_cc_on_pkt_acked;
   cc->congestion_event = ngtcp2_cc_reno_cc_congestion_event;
+  cc->on_spurious_congestion = ngtcp2_cc_reno_cc_on_spurious_congestion;
   cc->on_persistent_congestion = ngtcp2_cc_reno_cc_on_persistent_congestion;
   cc->on_ack_recv = ngtcp2_cc_reno_cc_on_ack_recv;
+  cc->on_pkt_sent = ngtcp2_cc_reno_cc_on_pkt_sent;
+  cc->new_rtt_sample = ngtcp2_cc_reno_cc_new_rtt_sample;
   cc->reset = ngtcp2_cc_reno_cc_reset;
+  cc->event = ngtcp2_cc_reno_cc_event;
 
   return 0;
 }
@@ -108,7 +409,9 @@ void ngtcp2_cc_reno_cc_on_pkt_acked(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
                                     ngtcp2_tstamp ts) {
   ngtcp2_reno_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_reno_cc, ccb);
   uint64_t m;
-  (void)ts;
+
+  hs_on_pkt_acked(&cc->hs, pkt);
+  cwv_on_pkt_acked(&cc->cwv, cstat, pkt, ts);
 
   if (in_congestion_recovery(cstat, pkt->sent_ts)) {
     return;
@@ -118,11 +421,12 @@ void ngtcp2_cc_reno_cc_on_pkt_acked(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
     return;
   }
 
+  if (cwv_limits_growth(&cc->cwv, cstat, pkt)) {
+    return;
+  }
+
   if (cstat->cwnd < cstat->ssthresh) {
-    cstat->cwnd += pkt->pktlen;
-    ngtcp2_log_info(cc->ccb.log, NGTCP2_LOG_EVENT_RCV,
-                    "pkn=%" PRId64 " acked, slow start cwnd=%" PRIu64,
-                    pkt->pkt_num, cstat->cwnd);
+    hs_slow_start(&cc->hs, cstat, pkt, cc->ccb.log, ts);
     return;
   }
 
@@ -142,6 +446,13 @@ void ngtcp2_cc_reno_cc_congestion_event(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
     return;
   }
 
+  if (cc->prior.cwnd < cstat->cwnd) {
+    cc->prior.cwnd = cstat->cwnd;
+    cc->prior.ssthresh = cstat->ssthresh;
+  }
+
+  hs_on_congestion_event(&cc->hs, cstat, ts);
+
   cstat->congestion_recovery_start_ts = ts;
   cstat->cwnd >>= NGTCP2_LOSS_REDUCTION_FACTOR_BITS;
   min_cwnd = 2 * cstat->max_udp_payload_size;
@@ -155,6 +466,30 @@ void ngtcp2_cc_reno_cc_congestion_event(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
                   cstat->cwnd);
 }
 
+void ngtcp2_cc_reno_cc_on_spurious_congestion(ngtcp2_cc *ccx,
+                                              ngtcp2_conn_stat *cstat,
+                                              ngtcp2_tstamp ts) {
+  ngtcp2_reno_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_reno_cc, ccb);
+  (void)ts;
+
+  if (cstat->cwnd >= cc->prior.cwnd) {
+    return;
+  }
+
+  cstat->congestion_recovery_start_ts = UINT64_MAX;
+
+  cstat->cwnd = cc->prior.cwnd;
+  cstat->ssthresh = cc->prior.ssthresh;
+
+  cc->prior.cwnd = 0;
+  cc->prior.ssthresh = 0;
+
+  ngtcp2_log_info(cc->ccb.log, NGTCP2_LOG_EVENT_RCV,
+                  "spurious congestion is detected and congestion state is "
+                  "restored cwnd=%" PRIu64,
+                  cstat->cwnd);
+}
+
 void ngtcp2_cc_reno_cc_on_persistent_congestion(ngtcp2_cc *ccx,
                                                 ngtcp2_conn_stat *cstat,
                                                 ngtcp2_tstamp ts) {
@@ -172,6 +507,8 @@ void ngtcp2_cc_reno_cc_on_ack_recv(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
   (void)ack;
   (void)ts;
 
+  cwv_update_burst_limit(&cc->cwv, cstat);
+
   /* TODO Use sliding window for min rtt measurement */
   /* TODO Use sliding window */
   cc->max_delivery_rate_sec =
@@ -189,6 +526,22 @@ void ngtcp2_cc_reno_cc_on_ack_recv(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
   }
 }
 
+void ngtcp2_cc_reno_cc_on_pkt_sent(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
+                                   const ngtcp2_cc_pkt *pkt) {
+  ngtcp2_reno_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_reno_cc, ccb);
+  (void)cstat;
+
+  hs_on_pkt_sent(&cc->hs, pkt);
+}
+
+void ngtcp2_cc_reno_cc_new_rtt_sample(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
+                                      ngtcp2_tstamp ts) {
+  ngtcp2_reno_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_reno_cc, ccb);
+  (void)ts;
+
+  hs_new_rtt_sample(&cc->hs, cstat);
+}
+
 void ngtcp2_cc_reno_cc_reset(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
                              ngtcp2_tstamp ts) {
   ngtcp2_reno_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_reno_cc, ccb);
@@ -198,6 +551,131 @@ void ngtcp2_cc_reno_cc_reset(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
   reno_cc_reset(cc);
 }
 
+void ngtcp2_cc_reno_cc_event(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
+                             ngtcp2_cc_event_type event, ngtcp2_tstamp ts) {
+  ngtcp2_reno_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_reno_cc, ccb);
+
+  if (event != NGTCP2_CC_EVENT_TYPE_TX_START || !cc->cwv.enabled) {
+    return;
+  }
+
+  cwv_update_period(&cc->cwv, cstat, ts);
+  cwv_limit_burst(&cc->cwv, cstat);
+}
+
+static void prague_cc_reset(ngtcp2_prague_cc *cc) {
+  reno_cc_reset(&cc->reno);
+  cc->alpha = NGTCP2_PRAGUE_ALPHA_MAX;
+  cc->ect_acked = 0;
+  cc->ce_acked = 0;
+  cc->round_start_ts = UINT64_MAX;
+}
+
+void ngtcp2_prague_cc_init(ngtcp2_prague_cc *cc, ngtcp2_log *log,
+                           int hystart, int cwnd_validation) {
+  cc->reno.ccb.log = log;
+  hs_init(&cc->reno.hs, hystart);
+  cwv_init(&cc->reno.cwv, cwnd_validation);
+  prague_cc_reset(cc);
+}
+
+void ngtcp2_prague_cc_free(ngtcp2_prague_cc *cc) { (void)cc; }
+
+int ngtcp2_cc_prague_cc_init(ngtcp2_cc *cc, ngtcp2_log *log, int hystart,
+                             int cwnd_validation, const ngtcp2_mem *mem) {
+  ngtcp2_prague_cc *prague_cc;
+
+  prague_cc = ngtcp2_mem_calloc(mem, 1, sizeof(ngtcp2_prague_cc));
+  if (prague_cc == NULL) {
+    return NGTCP2_ERR_NOMEM;
+  }
+
+  ngtcp2_prague_cc_init(prague_cc, log, hystart, cwnd_validation);
+
+  cc->ccb = &prague_cc->reno.ccb;
+  cc->on_pkt_acked = ngtcp2_cc_reno_cc_on_pkt_acked;
+  cc->congestion_event = ngtcp2_cc_reno_cc_congestion_event;
+  cc->on_spurious_congestion = ngtcp2_cc_reno_cc_on_spurious_congestion;
+  cc->on_persistent_congestion = ngtcp2_cc_reno_cc_on_persistent_congestion;
+  cc->on_ack_recv = ngtcp2_cc_reno_cc_on_ack_recv;
+  cc->on_pkt_sent = ngtcp2_cc_reno_cc_on_pkt_sent;
+  cc->new_rtt_sample = ngtcp2_cc_reno_cc_new_rtt_sample;
+  cc->reset = ngtcp2_cc_prague_cc_reset;
+  cc->event = ngtcp2_cc_reno_cc_event;
+  cc->on_ecn_ack = ngtcp2_cc_prague_cc_on_ecn_ack;
+
+  return 0;
+}
+
+void ngtcp2_cc_prague_cc_free(ngtcp2_cc *cc, const ngtcp2_mem *mem) {
+  ngtcp2_prague_cc *prague_cc =
+      ngtcp2_struct_of(cc->ccb, ngtcp2_prague_cc, reno.ccb);
+
+  ngtcp2_prague_cc_free(prague_cc);
+  ngtcp2_mem_free(mem, prague_cc);
+}
+
+void ngtcp2_cc_prague_cc_on_ecn_ack(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
+                                    uint64_t ect_acked, uint64_t ce_acked,
+                                    ngtcp2_tstamp sent_ts, ngtcp2_tstamp ts) {
+  ngtcp2_prague_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_prague_cc, reno.ccb);
+  uint64_t total, min_cwnd;
+
+  cc->ect_acked += ect_acked;
+  cc->ce_acked += ce_acked;
+
+  if (cc->round_start_ts == UINT64_MAX) {
+    cc->round_start_ts = ts;
+  } else if (sent_ts >= cc->round_start_ts) {
+    total = cc->ect_acked + cc->ce_acked;
+    if (total) {
+      /* alpha = (1 - g) * alpha + g * F */
+      cc->alpha -= cc->alpha >> NGTCP2_PRAGUE_G_SHIFT;
+      cc->alpha += (cc->ce_acked << (NGTCP2_PRAGUE_ALPHA_BITS -
+                                     NGTCP2_PRAGUE_G_SHIFT)) /
+                   total;
+      cc->alpha = ngtcp2_min(cc->alpha, NGTCP2_PRAGUE_ALPHA_MAX);
+    }
+
+    cc->ect_acked = 0;
+    cc->ce_acked = 0;
+    cc->round_start_ts = ts;
+  }
+
+  if (ce_acked == 0 || in_congestion_recovery(cstat, sent_ts)) {
+    return;
+  }
+
+  /* CE marking is not undone even if the preceding packet loss turns
+     out to be spurious. */
+  cc->reno.prior.cwnd = 0;
+  cc->reno.prior.ssthresh = 0;
+
+  hs_on_congestion_event(&cc->reno.hs, cstat, ts);
+
+  cstat->congestion_recovery_start_ts = ts;
+  cstat->cwnd -= (cstat->cwnd * cc->alpha) >> (NGTCP2_PRAGUE_ALPHA_BITS + 1);
+  min_cwnd = 2 * cstat->max_udp_payload_size;
+  cstat->cwnd = ngtcp2_max(cstat->cwnd, min_cwnd);
+  cstat->ssthresh = cstat->cwnd;
+
+  cc->reno.pending_add = 0;
+
+  ngtcp2_log_info(cc->reno.ccb.log, NGTCP2_LOG_EVENT_RCV,
+                  "reduce cwnd because of CE marking cwnd=%" PRIu64
+                  " alpha=%" PRIu64,
+                  cstat->cwnd, cc->alpha);
+}
+
+void ngtcp2_cc_prague_cc_reset(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
+                               ngtcp2_tstamp ts) {
+  ngtcp2_prague_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_prague_cc, reno.ccb);
+  (void)cstat;
+  (void)ts;
+
+  prague_cc_reset(cc);
+}
+
 static void cubic_cc_reset(ngtcp2_cubic_cc *cc) {
   cc->max_delivery_rate_sec = 0;
   cc->target_cwnd = 0;
@@ -215,21 +693,22 @@ static void cubic_cc_reset(ngtcp2_cubic_cc *cc) {
   cc->prior.epoch_start = UINT64_MAX;
   cc->prior.k = 0;
 
-  cc->rtt_sample_count = 0;
-  cc->current_round_min_rtt = UINT64_MAX;
-  cc->last_round_min_rtt = UINT64_MAX;
-  cc->window_end = -1;
+  hs_reset(&cc->hs);
+  cwv_reset(&cc->cwv);
 }
 
-void ngtcp2_cubic_cc_init(ngtcp2_cubic_cc *cc, ngtcp2_log *log) {
+void ngtcp2_cubic_cc_init(ngtcp2_cubic_cc *cc, ngtcp2_log *log, int hystart,
+                          int cwnd_validation) {
   cc->ccb.log = log;
+  hs_init(&cc->hs, hystart);
+  cwv_init(&cc->cwv, cwnd_validation);
   cubic_cc_reset(cc);
 }
 
 void ngtcp2_cubic_cc_free(ngtcp2_cubic_cc *cc) { (void)cc; }
 
-int ngtcp2_cc_cubic_cc_init(ngtcp2_cc *cc, ngtcp2_log *log,
-                            const ngtcp2_mem *mem) {
+int ngtcp2_cc_cubic_cc_init(ngtcp2_cc *cc, ngtcp2_log *log, int hystart,
+                            int cwnd_validation, const ngtcp2_mem *mem) {
   ngtcp2_cubic_cc *cubic_cc;
 
   cubic_cc = ngtcp2_mem_calloc(mem, 1, sizeof(ngtcp2_cubic_cc));
@@ -237,7 +716,7 @@ int ngtcp2_cc_cubic_cc_init(ngtcp2_cc *cc, ngtcp2_log *log,
     return NGTCP2_ERR_NOMEM;
   }
 
-  ngtcp2_cubic_cc_init(cubic_cc, log);
+  ngtcp2_cubic_cc_init(cubic_cc, log, hystart, cwnd_validation);
 
   cc->ccb = &cubic_cc->ccb;
   cc->on_pkt_acked = ngtcp2_cc_cubic_cc_on_pkt_acked;
@@ -297,26 +776,18 @@ static uint64_t ngtcp2_cbrt(uint64_t n) {
   return a;
 }
 
-/* HyStart++ constants */
-#define NGTCP2_HS_MIN_SSTHRESH 16
-#define NGTCP2_HS_N_RTT_SAMPLE 8
-#define NGTCP2_HS_MIN_ETA (4 * NGTCP2_MILLISECONDS)
-#define NGTCP2_HS_MAX_ETA (16 * NGTCP2_MILLISECONDS)
-
 void ngtcp2_cc_cubic_cc_on_pkt_acked(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
                                      const ngtcp2_cc_pkt *pkt,
                                      ngtcp2_tstamp ts) {
   ngtcp2_cubic_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_cubic_cc, ccb);
-  ngtcp2_duration t, min_rtt, eta;
+  ngtcp2_duration t, min_rtt;
   uint64_t target;
   uint64_t tx, kx, time_delta, delta;
   uint64_t add, tcp_add;
   uint64_t m;
 
-  if (pkt->pktns_id == NGTCP2_PKTNS_ID_APPLICATION && cc->window_end != -1 &&
-      cc->window_end <= pkt->pkt_num) {
-    cc->window_end = -1;
-  }
+  hs_on_pkt_acked(&cc->hs, pkt);
+  cwv_on_pkt_acked(&cc->cwv, cstat, pkt, ts);
 
   if (in_congestion_recovery(cstat, pkt->sent_ts)) {
     return;
@@ -326,33 +797,14 @@ void ngtcp2_cc_cubic_cc_on_pkt_acked(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
     return;
   }
 
+  if (cwv_limits_growth(&cc->cwv, cstat, pkt)) {
+    return;
+  }
+
   if (cstat->cwnd < cstat->ssthresh) {
     /* slow-start */
-    cstat->cwnd += pkt->pktlen;
-
-    ngtcp2_log_info(cc->ccb.log, NGTCP2_LOG_EVENT_RCV,
-                    "pkn=%" PRId64 " acked, slow start cwnd=%" PRIu64,
-                    pkt->pkt_num, cstat->cwnd);
-
-    if (cc->last_round_min_rtt != UINT64_MAX &&
-        cc->current_round_min_rtt != UINT64_MAX &&
-        cstat->cwnd >= NGTCP2_HS_MIN_SSTHRESH * cstat->max_udp_payload_size &&
-        cc->rtt_sample_count >= NGTCP2_HS_N_RTT_SAMPLE) {
-      eta = cc->last_round_min_rtt / 8;
-
-      if (eta < NGTCP2_HS_MIN_ETA) {
-        eta = NGTCP2_HS_MIN_ETA;
-      } else if (eta > NGTCP2_HS_MAX_ETA) {
-        eta = NGTCP2_HS_MAX_ETA;
-      }
-
-      if (cc->current_round_min_rtt >= cc->last_round_min_rtt + eta) {
-        ngtcp2_log_info(cc->ccb.log, NGTCP2_LOG_EVENT_RCV,
-                        "HyStart++ exit slow start");
-
-        cc->w_last_max = cstat->cwnd;
-        cstat->ssthresh = cstat->cwnd;
-      }
+    if (hs_slow_start(&cc->hs, cstat, pkt, cc->ccb.log, ts)) {
+      cc->w_last_max = cstat->cwnd;
     }
 
     return;
@@ -458,6 +910,8 @@ void ngtcp2_cc_cubic_cc_congestion_event(ngtcp2_cc *ccx,
     cc->prior.k = cc->k;
   }
 
+  hs_on_congestion_event(&cc->hs, cstat, ts);
+
   cstat->congestion_recovery_start_ts = ts;
 
   cc->epoch_start = UINT64_MAX;
@@ -529,6 +983,8 @@ void ngtcp2_cc_cubic_cc_on_ack_recv(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
   (void)ack;
   (void)ts;
 
+  cwv_update_burst_limit(&cc->cwv, cstat);
+
   /* TODO Use sliding window for min rtt measurement */
   /* TODO Use sliding window */
   cc->max_delivery_rate_sec =
@@ -551,14 +1007,7 @@ void ngtcp2_cc_cubic_cc_on_pkt_sent(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
   ngtcp2_cubic_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_cubic_cc, ccb);
   (void)cstat;
 
-  if (pkt->pktns_id != NGTCP2_PKTNS_ID_APPLICATION || cc->window_end != -1) {
-    return;
-  }
-
-  cc->window_end = pkt->pkt_num;
-  cc->last_round_min_rtt = cc->current_round_min_rtt;
-  cc->current_round_min_rtt = UINT64_MAX;
-  cc->rtt_sample_count = 0;
+  hs_on_pkt_sent(&cc->hs, pkt);
 }
 
 void ngtcp2_cc_cubic_cc_new_rtt_sample(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
@@ -566,13 +1015,7 @@ void ngtcp2_cc_cubic_cc_new_rtt_sample(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
   ngtcp2_cubic_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_cubic_cc, ccb);
   (void)ts;
 
-  if (cc->window_end == -1) {
-    return;
-  }
-
-  cc->current_round_min_rtt =
-      ngtcp2_min(cc->current_round_min_rtt, cstat->latest_rtt);
-  ++cc->rtt_sample_count;
+  hs_new_rtt_sample(&cc->hs, cstat);
 }
 
 void ngtcp2_cc_cubic_cc_reset(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
@@ -589,7 +1032,16 @@ void ngtcp2_cc_cubic_cc_event(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
   ngtcp2_cubic_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_cubic_cc, ccb);
   ngtcp2_tstamp last_ts;
 
-  if (event != NGTCP2_CC_EVENT_TYPE_TX_START || cc->epoch_start == UINT64_MAX) {
+  if (event != NGTCP2_CC_EVENT_TYPE_TX_START) {
+    return;
+  }
+
+  if (cc->cwv.enabled) {
+    cwv_update_period(&cc->cwv, cstat, ts);
+    cwv_limit_burst(&cc->cwv, cstat);
+  }
+
+  if (cc->epoch_start == UINT64_MAX) {
     return;
   }
 
@@ -602,3 +1054,133 @@ void ngtcp2_cc_cubic_cc_event(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
 
   cc->epoch_start += ts - last_ts;
 }
+
+static void user_cc_on_pkt_acked(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
+                                 const ngtcp2_cc_pkt *pkt, ngtcp2_tstamp ts) {
+  ngtcp2_user_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_user_cc, ccb);
+
+  if (cc->callbacks.on_pkt_acked) {
+    cc->callbacks.on_pkt_acked(cc->conn, cstat, pkt, ts,
+                               cc->conn->user_data);
+  }
+}
+
+static void user_cc_on_pkt_lost(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
+                                const ngtcp2_cc_pkt *pkt, ngtcp2_tstamp ts) {
+  ngtcp2_user_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_user_cc, ccb);
+
+  cc->callbacks.on_pkt_lost(cc->conn, cstat, pkt, ts, cc->conn->user_data);
+}
+
+static void user_cc_congestion_event(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
+                                     ngtcp2_tstamp sent_ts,
+                                     ngtcp2_tstamp ts) {
+  ngtcp2_user_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_user_cc, ccb);
+
+  if (cc->callbacks.congestion_event) {
+    cc->callbacks.congestion_event(cc->conn, cstat, sent_ts, ts,
+                                   cc->conn->user_data);
+  }
+}
+
+static void user_cc_on_spurious_congestion(ngtcp2_cc *ccx,
+                                           ngtcp2_conn_stat *cstat,
+                                           ngtcp2_tstamp ts) {
+  ngtcp2_user_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_user_cc, ccb);
+
+  cc->callbacks.on_spurious_congestion(cc->conn, cstat, ts,
+                                       cc->conn->user_data);
+}
+
+static void user_cc_on_persistent_congestion(ngtcp2_cc *ccx,
+                                             ngtcp2_conn_stat *cstat,
+                                             ngtcp2_tstamp ts) {
+  ngtcp2_user_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_user_cc, ccb);
+
+  if (cc->callbacks.on_persistent_congestion) {
+    cc->callbacks.on_persistent_congestion(cc->conn, cstat, ts,
+                                           cc->conn->user_data);
+  }
+}
+
+static void user_cc_on_ack_recv(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
+                                const ngtcp2_cc_ack *ack, ngtcp2_tstamp ts) {
+  ngtcp2_user_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_user_cc, ccb);
+
+  if (cc->callbacks.on_ack_recv) {
+    cc->callbacks.on_ack_recv(cc->conn, cstat, ack, &cc->rst->rs, ts,
+                              cc->conn->user_data);
+  }
+}
+
+static void user_cc_on_pkt_sent(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
+                                const ngtcp2_cc_pkt *pkt) {
+  ngtcp2_user_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_user_cc, ccb);
+
+  cc->callbacks.on_pkt_sent(cc->conn, cstat, pkt, cc->conn->user_data);
+}
+
+static void user_cc_new_rtt_sample(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
+                                   ngtcp2_tstamp ts) {
+  ngtcp2_user_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_user_cc, ccb);
+
+  cc->callbacks.new_rtt_sample(cc->conn, cstat, ts, cc->conn->user_data);
+}
+
+static void user_cc_reset(ngtcp2_cc *ccx, ngtcp2_conn_stat *cstat,
+                          ngtcp2_tstamp ts) {
+  ngtcp2_user_cc *cc = ngtcp2_struct_of(ccx->ccb, ngtcp2_user_cc, ccb);
+
+  if (cc->callbacks.reset) {
+    cc->callbacks.reset(cc->conn, cstat, ts, cc->conn->user_data);
+  }
+}
+
+int ngtcp2_cc_user_cc_init(ngtcp2_cc *cc, ngtcp2_log *log,
+                           ngtcp2_conn *conn, ngtcp2_rst *rst,
+                           const ngtcp2_cc_callbacks *callbacks,
+                           const ngtcp2_mem *mem) {
+  ngtcp2_user_cc *user_cc;
+
+  user_cc = ngtcp2_mem_calloc(mem, 1, sizeof(ngtcp2_user_cc));
+  if (user_cc == NULL) {
+    return NGTCP2_ERR_NOMEM;
+  }
+
+  user_cc->ccb.log = log;
+  user_cc->callbacks = *callbacks;
+  user_cc->conn = conn;
+  user_cc->rst = rst;
+
+  memset(cc, 0, sizeof(*cc));
+
+  cc->ccb = &user_cc->ccb;
+  cc->on_pkt_acked = user_cc_on_pkt_acked;
+  cc->congestion_event = user_cc_congestion_event;
+  cc->on_persistent_congestion = user_cc_on_persistent_congestion;
+  cc->on_ack_recv = user_cc_on_ack_recv;
+  cc->reset = user_cc_reset;
+
+  /* The library checks these callbacks for NULL before calling
+     them. */
+  if (callbacks->on_pkt_lost) {
+    cc->on_pkt_lost = user_cc_on_pkt_lost;
+  }
+  if (callbacks->on_spurious_congestion) {
+    cc->on_spurious_congestion = user_cc_on_spurious_congestion;
+  }
+  if (callbacks->on_pkt_sent) {
+    cc->on_pkt_sent = user_cc_on_pkt_sent;
+  }
+  if (callbacks->new_rtt_sample) {
+    cc->new_rtt_sample = user_cc_new_rtt_sample;
+  }
+
+  return 0;
+}
+
+void ngtcp2_cc_user_cc_free(ngtcp2_cc *cc, const ngtcp2_mem *mem) {
+  ngtcp2_user_cc *user_cc = ngtcp2_struct_of(cc->ccb, ngtcp2_user_cc, ccb);
+
+  ngtcp2_mem_free(mem, user_cc);
+}
@@ -35,6 +35,7 @@
 #define NGTCP2_PERSISTENT_CONGESTION_THRESHOLD 3
 
 typedef struct ngtcp2_log ngtcp2_log;
+typedef struct ngtcp2_rst ngtcp2_rst;
 
 /**
  * @struct
@@ -50,84 +51,6 @@ typedef struct ngtcp2_cc_base {
   ngtcp2_log *log;
 } ngtcp2_cc_base;
 
-/**
- * @struct
- *
- * :type:`ngtcp2_cc_pkt` is a convenient structure to include
- * acked/lost/sent packet.
- */
-typedef struct ngtcp2_cc_pkt {
-  /**
-   * :member:`pkt_num` is the packet number
-   */
-  int64_t pkt_num;
-  /**
-   * :member:`pktlen` is the length of packet.
-   */
-  size_t pktlen;
-  /**
-   * :member:`pktns_id` is the ID of packet number space which this
-   * packet belongs to.
-   */
-  ngtcp2_pktns_id pktns_id;
-  /**
-   * :member:`sent_ts` is the timestamp when packet is sent.
-   */
-  ngtcp2_tstamp sent_ts;
-  /**
-   * :member:`lost` is the number of bytes lost when this packet was
-   * sent.
-   */
-  uint64_t lost;
-  /**
-   * :member:`tx_in_flight` is the bytes in flight when this packet
-   * was sent.
-   */
-  uint64_t tx_in_flight;
-  /**
-   * :member:`is_app_limited` is nonzero if the connection is
-   * app-limited when this packet was sent.
-   */
-  int is_app_limited;
-} ngtcp2_cc_pkt;
-
-/**
- * @struct
- *
- * :type:`ngtcp2_cc_ack` is a convenient structure which stores
- * acknowledged and lost bytes.
- */
-typedef struct ngtcp2_cc_ack {
-  /**
-   * :member:`prior_bytes_in_flight` is the in-flight bytes before
-   * processing this ACK.
-   */
-  uint64_t prior_bytes_in_flight;
-  /**
-   * :member:`bytes_delivered` is the number of bytes acknowledged.
-   */
-  uint64_t bytes_delivered;
-  /**
-   * :member:`bytes_lost` is the number of bytes declared lost.
-   */
-  uint64_t bytes_lost;
-  /**
-   * :member:`pkt_delivered` is the cumulative acknowledged bytes when
-   * the last packet acknowledged by this ACK was sent.
-   */
-  uint64_t pkt_delivered;
-  /**
-   * :member:`largest_acked_sent_ts` is the time when the largest
-   * acknowledged packet was sent.
-   */
-  ngtcp2_tstamp largest_acked_sent_ts;
-  /**
-   * :member:`rtt` is the RTT sample.  It is UINT64_MAX if no RTT
-   * sample is available.
-   */
-  ngtcp2_duration rtt;
-} ngtcp2_cc_ack;
-
 typedef struct ngtcp2_cc ngtcp2_cc;
 
 /**
@@ -239,6 +162,20 @@ typedef enum ngtcp2_cc_event_type {
 typedef void (*ngtcp2_cc_event)(ngtcp2_cc *cc, ngtcp2_conn_stat *cstat,
                                 ngtcp2_cc_event_type event, ngtcp2_tstamp ts);
 
+/**
+ * @functypedef
+ *
+ * :type:`ngtcp2_cc_on_ecn_ack` is a callback function which is called
+ * when ACK_ECN frame acknowledges new packets.  |ect_acked| is the
+ * number of packets newly reported as received with ECT(0) or ECT(1)
+ * marking, and |ce_acked| is the number of packets newly reported as
+ * received with CE marking.  |sent_ts| is the time when the largest
+ * acknowledged packet was sent.
+ */
+typedef void (*ngtcp2_cc_on_ecn_ack)(ngtcp2_cc *cc, ngtcp2_conn_stat *cstat,
+                                     uint64_t ect_acked, uint64_t ce_acked,
+                                     ngtcp2_tstamp sent_ts, ngtcp2_tstamp ts);
+
 /**
  * @struct
  *
@@ -301,6 +238,13 @@ typedef struct ngtcp2_cc {
    * specific event happens.
    */
   ngtcp2_cc_event event;
+  /**
+   * :member:`on_ecn_ack` is a callback function which is called when
+   * ACK_ECN frame acknowledges new packets.  If it is NULL,
+   * :member:`congestion_event` is called when CE marking is
+   * reported.
+   */
+  ngtcp2_cc_on_ecn_ack on_ecn_ack;
 } ngtcp2_cc;
 
 /*
@@ -313,20 +257,83 @@ ngtcp2_cc_pkt *ngtcp2_cc_pkt_init(ngtcp2_cc_pkt *pkt, int64_t pkt_num,
                                   ngtcp2_tstamp sent_ts, uint64_t lost,
                                   uint64_t tx_in_flight, int is_app_limited);
 
+/* ngtcp2_hs is the state of HyStart++ (RFC 9406) shared by Reno and
+   CUBIC. */
+typedef struct ngtcp2_hs {
+  /* enabled is nonzero if HyStart++ is used in the initial slow
+     start. */
+  int enabled;
+  size_t rtt_sample_count;
+  uint64_t current_round_min_rtt;
+  uint64_t last_round_min_rtt;
+  /* window_end is the packet number which ends the current round.
+     -1 means that the next packet sent starts a new round. */
+  int64_t window_end;
+  /* css_baseline_min_rtt is the minimum RTT of the round that
+     entered Conservative Slow Start.  UINT64_MAX means that
+     Conservative Slow Start is not in progress. */
+  uint64_t css_baseline_min_rtt;
+  /* css_round is the number of rounds that have finished in
+     Conservative Slow Start. */
+  size_t css_round;
+  /* pending_add is the remainder of the acknowledged bytes which are
+     divided by the growth divisor in Conservative Slow Start. */
+  uint64_t pending_add;
+} ngtcp2_hs;
+
+/* ngtcp2_cwv is the state of congestion window validation (RFC 7661)
+   shared by Reno and CUBIC.  The congestion window is validated if
+   the sender used at least half of it recently.  An acknowledgement
+   of a packet sent while app-limited does not grow the congestion
+   window unless it is validated. */
+typedef struct ngtcp2_cwv {
+  /* enabled is nonzero if congestion window validation is used. */
+  int enabled;
+  /* pipeack is the largest number of bytes in flight when the
+     packets acknowledged in the current sampling period were
+     sent. */
+  uint64_t pipeack;
+  /* prev_pipeack is pipeack of the previous sampling period. */
+  uint64_t prev_pipeack;
+  /* period_ts is the time when the current sampling period started.
+     UINT64_MAX means that no sampling period has started yet. */
+  ngtcp2_tstamp period_ts;
+  /* burst_limited is nonzero if send_quantum is limited to the
+     initial window because the sender restarted from app-limited
+     while the congestion window was not validated. */
+  int burst_limited;
+} ngtcp2_cwv;
+
 /* ngtcp2_reno_cc is the RENO congestion controller. */
 typedef struct ngtcp2_reno_cc {
   ngtcp2_cc_base ccb;
   uint64_t max_delivery_rate_sec;
   uint64_t target_cwnd;
   uint64_t pending_add;
+  /* prior is the congestion state before the last reduction due to
+     packet loss.  It is restored if the loss turns out to be
+     spurious. */
+  struct {
+    uint64_t cwnd;
+    uint64_t ssthresh;
+  } prior;
+  ngtcp2_hs hs;
+  ngtcp2_cwv cwv;
 } ngtcp2_reno_cc;
 
-int ngtcp2_cc_reno_cc_init(ngtcp2_cc *cc, ngtcp2_log *log,
-                           const ngtcp2_mem *mem);
+/*
+ * ngtcp2_cc_reno_cc_init initializes |cc| with Reno.  If |hystart|
+ * is nonzero, HyStart++ is used in the initial slow start.  If
+ * |cwnd_validation| is nonzero, congestion window validation is
+ * used.
+ */
+int ngtcp2_cc_reno_cc_init(ngtcp2_cc *cc, ngtcp2_log *log, int hystart,
+                           int cwnd_validation, const ngtcp2_mem *mem);
 
 void ngtcp2_cc_reno_cc_free(ngtcp2_cc *cc, const ngtcp2_mem *mem);
 
-void ngtcp2_reno_cc_init(ngtcp2_reno_cc *cc, ngtcp2_log *log);
+void ngtcp2_reno_cc_init(ngtcp2_reno_cc *cc, ngtcp2_log *log, int hystart,
+                         int cwnd_validation);
 
 void ngtcp2_reno_cc_free(ngtcp2_reno_cc *cc);
 
@@ -337,6 +344,10 @@ void ngtcp2_cc_reno_cc_congestion_event(ngtcp2_cc *cc, ngtcp2_conn_stat *cstat,
                                         ngtcp2_tstamp sent_ts,
                                         ngtcp2_tstamp ts);
 
+void ngtcp2_cc_reno_cc_on_spurious_congestion(ngtcp2_cc *cc,
+                                              ngtcp2_conn_stat *cstat,
+                                              ngtcp2_tstamp ts);
+
 void ngtcp2_cc_reno_cc_on_persistent_congestion(ngtcp2_cc *cc,
                                                 ngtcp2_conn_stat *cstat,
                                                 ngtcp2_tstamp ts);
@@ -344,9 +355,70 @@ void ngtcp2_cc_reno_cc_on_persistent_congestion(ngtcp2_cc *cc,
 void ngtcp2_cc_reno_cc_on_ack_recv(ngtcp2_cc *cc, ngtcp2_conn_stat *cstat,
                                    const ngtcp2_cc_ack *ack, ngtcp2_tstamp ts);
 
+void ngtcp2_cc_reno_cc_on_pkt_sent(ngtcp2_cc *cc, ngtcp2_conn_stat *cstat,
+                                   const ngtcp2_cc_pkt *pkt);
+
+void ngtcp2_cc_reno_cc_new_rtt_sample(ngtcp2_cc *cc, ngtcp2_conn_stat *cstat,
+                                      ngtcp2_tstamp ts);
+
 void ngtcp2_cc_reno_cc_reset(ngtcp2_cc *cc, ngtcp2_conn_stat *cstat,
                              ngtcp2_tstamp ts);
 
+void ngtcp2_cc_reno_cc_event(ngtcp2_cc *cc, ngtcp2_conn_stat *cstat,
+                             ngtcp2_cc_event_type event, ngtcp2_tstamp ts);
+
+/* NGTCP2_PRAGUE_ALPHA_BITS is the number of fractional bits of
+   ngtcp2_prague_cc.alpha. */
+#define NGTCP2_PRAGUE_ALPHA_BITS 10
+/* NGTCP2_PRAGUE_ALPHA_MAX is alpha when all packets are CE marked. */
+#define NGTCP2_PRAGUE_ALPHA_MAX (1 << NGTCP2_PRAGUE_ALPHA_BITS)
+/* NGTCP2_PRAGUE_G_SHIFT is the EWMA gain of alpha expressed as a
+   shift.  The gain is 1/16. */
+#define NGTCP2_PRAGUE_G_SHIFT 4
+
+/* ngtcp2_prague_cc is Prague congestion controller for L4S.  It is
+   Reno except that it reduces cwnd in proportion to the fraction of
+   CE marked packets like DCTCP (RFC 8257). */
+typedef struct ngtcp2_prague_cc {
+  /* reno must be the first field because Prague shares the Reno
+     callbacks except for ECN handling. */
+  ngtcp2_reno_cc reno;
+  /* alpha is the moving average of the fraction of CE marked
+     packets per round, scaled by NGTCP2_PRAGUE_ALPHA_MAX. */
+  uint64_t alpha;
+  /* ect_acked and ce_acked are the number of packets reported as
+     ECT and CE marked respectively in the current round. */
+  uint64_t ect_acked;
+  uint64_t ce_acked;
+  /* round_start_ts is the time when the current round started.  The
+     round ends when a packet sent after this time is acknowledged.
+     UINT64_MAX means that no round has started yet. */
+  ngtcp2_tstamp round_start_ts;
+} ngtcp2_prague_cc;
+
+/*
+ * ngtcp2_cc_prague_cc_init initializes |cc| with Prague.  If
+ * |hystart| is nonzero, HyStart++ is used in the initial slow start.
+ * If |cwnd_validation| is nonzero, congestion window validation is
+ * used.
+ */
+int ngtcp2_cc_prague_cc_init(ngtcp2_cc *cc, ngtcp2_log *log, int hystart,
+                             int cwnd_validation, const ngtcp2_mem *mem);
+
+void ngtcp2_cc_prague_cc_free(ngtcp2_cc *cc, const ngtcp2_mem *mem);
+
+void ngtcp2_prague_cc_init(ngtcp2_prague_cc *cc, ngtcp2_log *log,
+                           int hystart, int cwnd_validation);
+
+void ngtcp2_prague_cc_free(ngtcp2_prague_cc *cc);
+
+void ngtcp2_cc_prague_cc_on_ecn_ack(ngtcp2_cc *cc, ngtcp2_conn_stat *cstat,
+                                    uint64_t ect_acked, uint64_t ce_acked,
+                                    ngtcp2_tstamp sent_ts, ngtcp2_tstamp ts);
+
+void ngtcp2_cc_prague_cc_reset(ngtcp2_cc *cc, ngtcp2_conn_stat *cstat,
+                               ngtcp2_tstamp ts);
+
 /* ngtcp2_cubic_cc is CUBIC congestion controller. */
 typedef struct ngtcp2_cubic_cc {
   ngtcp2_cc_base ccb;
@@ -369,21 +441,25 @@ typedef struct ngtcp2_cubic_cc {
     ngtcp2_tstamp epoch_start;
     uint64_t k;
   } prior;
-  /* HyStart++ variables */
-  size_t rtt_sample_count;
-  uint64_t current_round_min_rtt;
-  uint64_t last_round_min_rtt;
-  int64_t window_end;
+  ngtcp2_hs hs;
+  ngtcp2_cwv cwv;
   uint64_t pending_add;
   uint64_t pending_w_add;
 } ngtcp2_cubic_cc;
 
-int ngtcp2_cc_cubic_cc_init(ngtcp2_cc *cc, ngtcp2_log *log,
-                            const ngtcp2_mem *mem);
+/*
+ * ngtcp2_cc_cubic_cc_init initializes |cc| with CUBIC.  If |hystart|
+ * is nonzero, HyStart++ is used in the initial slow start.  If
+ * |cwnd_validation| is nonzero, congestion window validation is
+ * used.
+ */
+int ngtcp2_cc_cubic_cc_init(ngtcp2_cc *cc, ngtcp2_log *log, int hystart,
+                            int cwnd_validation, const ngtcp2_mem *mem);
 
 void ngtcp2_cc_cubic_cc_free(ngtcp2_cc *cc, const ngtcp2_mem *mem);
 
-void ngtcp2_cubic_cc_init(ngtcp2_cubic_cc *cc, ngtcp2_log *log);
+void ngtcp2_cubic_cc_init(ngtcp2_cubic_cc *cc, ngtcp2_log *log, int hystart,
+                          int cwnd_validation);
 
 void ngtcp2_cubic_cc_free(ngtcp2_cubic_cc *cc);
 
@@ -418,4 +494,32 @@ void ngtcp2_cc_cubic_cc_reset(ngtcp2_cc *cc, ngtcp2_conn_stat *cstat,
 void ngtcp2_cc_cubic_cc_event(ngtcp2_cc *cc, ngtcp2_conn_stat *cstat,
                               ngtcp2_cc_event_type event, ngtcp2_tstamp ts);
 
+/* ngtcp2_user_cc forwards congestion control events to the
+   callbacks provided by application. */
+typedef struct ngtcp2_user_cc {
+  ngtcp2_cc_base ccb;
+  ngtcp2_cc_callbacks callbacks;
+  /* conn is the connection which owns this object.  Its user_data is
+     passed to the callbacks. */
+  ngtcp2_conn *conn;
+  ngtcp2_rst *rst;
+} ngtcp2_user_cc;
+
+/*
+ * ngtcp2_cc_user_cc_init initializes |cc| with the congestion
+ * controller implemented by |callbacks|, which is copied.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ */
+int ngtcp2_cc_user_cc_init(ngtcp2_cc *cc, ngtcp2_log *log,
+                           ngtcp2_conn *conn, ngtcp2_rst *rst,
+                           const ngtcp2_cc_callbacks *callbacks,
+                           const ngtcp2_mem *mem);
+
+void ngtcp2_cc_user_cc_free(ngtcp2_cc *cc, const ngtcp2_mem *mem);
+
 #endif /* NGTCP2_CC_H */
@@ -29,6 +29,7 @@
 
 #include "ngtcp2_path.h"
 #include "ngtcp2_str.h"
+#include "ngtcp2_macro.h"
 
 void ngtcp2_cid_zero(ngtcp2_cid *cid) { memset(cid, 0, sizeof(*cid)); }
 
@@ -86,6 +87,26 @@ void ngtcp2_dcid_init(ngtcp2_dcid *dcid, uint64_t seq, const ngtcp2_cid *cid,
   dcid->bytes_sent = 0;
   dcid->bytes_recv = 0;
   dcid->max_udp_payload_size = NGTCP2_MAX_UDP_PAYLOAD_SIZE;
+  ngtcp2_dcid_reset_path_stat(dcid);
+}
+
+void ngtcp2_dcid_reset_path_stat(ngtcp2_dcid *dcid) {
+  dcid->latest_rtt = 0;
+  dcid->min_rtt = UINT64_MAX;
+  dcid->smoothed_rtt = 0;
+  dcid->lost_pkt_count = 0;
+  dcid->validated_ts = UINT64_MAX;
+}
+
+void ngtcp2_dcid_add_rtt_sample(ngtcp2_dcid *dcid, ngtcp2_duration rtt) {
+  dcid->latest_rtt = rtt;
+  dcid->min_rtt = ngtcp2_min(dcid->min_rtt, rtt);
+
+  if (dcid->smoothed_rtt == 0) {
+    dcid->smoothed_rtt = rtt;
+  } else {
+    dcid->smoothed_rtt = (dcid->smoothed_rtt * 7 + rtt) / 8;
+  }
 }
 
 void ngtcp2_dcid_set_token(ngtcp2_dcid *dcid, const uint8_t *token) {
@@ -110,6 +131,11 @@ void ngtcp2_dcid_copy(ngtcp2_dcid *dest, const ngtcp2_dcid *src) {
   dest->bytes_sent = src->bytes_sent;
   dest->bytes_recv = src->bytes_recv;
   dest->max_udp_payload_size = src->max_udp_payload_size;
+  dest->latest_rtt = src->latest_rtt;
+  dest->min_rtt = src->min_rtt;
+  dest->smoothed_rtt = src->smoothed_rtt;
+  dest->lost_pkt_count = src->lost_pkt_count;
+  dest->validated_ts = src->validated_ts;
 }
 
 void ngtcp2_dcid_copy_cid_token(ngtcp2_dcid *dest, const ngtcp2_dcid *src) {
@@ -126,7 +152,7 @@ void ngtcp2_dcid_copy_cid_token(ngtcp2_dcid *dest, const ngtcp2_dcid *src) {
 int ngtcp2_dcid_verify_uniqueness(ngtcp2_dcid *dcid, uint64_t seq,
                                   const ngtcp2_cid *cid, const uint8_t *token) {
   if (dcid->seq == seq) {
-    return ngtcp2_cid_eq(&dcid->cid, cid) &&
+    return ngtcp2_cid_eq_inline(&dcid->cid, cid) &&
                    (dcid->flags & NGTCP2_DCID_FLAG_TOKEN_PRESENT) &&
                    memcmp(dcid->token, token,
                           NGTCP2_STATELESS_RESET_TOKENLEN) == 0
@@ -134,7 +160,7 @@ int ngtcp2_dcid_verify_uniqueness(ngtcp2_dcid *dcid, uint64_t seq,
                : NGTCP2_ERR_PROTO;
   }
 
-  return !ngtcp2_cid_eq(&dcid->cid, cid) ? 0 : NGTCP2_ERR_PROTO;
+  return !ngtcp2_cid_eq_inline(&dcid->cid, cid) ? 0 : NGTCP2_ERR_PROTO;
 }
 
 int ngtcp2_dcid_verify_stateless_reset_token(const ngtcp2_dcid *dcid,
@@ -29,6 +29,8 @@
 #  include <config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <string.h>
+
 #include <ngtcp2/ngtcp2.h>
 
 #include "ngtcp2_pq.h"
@@ -88,6 +90,19 @@ typedef struct ngtcp2_dcid {
   /* max_udp_payload_size is the maximum size of UDP payload that is
      allowed to send to this path. */
   size_t max_udp_payload_size;
+  /* latest_rtt, min_rtt, and smoothed_rtt are RTT measured on an
+     associated path.  They are sampled by path validation, and they
+     are saved from ngtcp2_conn_stat when the path stops being the
+     current path.  smoothed_rtt is 0 if RTT has not been measured. */
+  ngtcp2_duration latest_rtt;
+  ngtcp2_duration min_rtt;
+  ngtcp2_duration smoothed_rtt;
+  /* lost_pkt_count is the number of packets which were declared lost
+     while an associated path was the current path. */
+  uint64_t lost_pkt_count;
+  /* validated_ts is the timestamp when an associated path was
+     validated.  It is UINT64_MAX if it has not been validated. */
+  ngtcp2_tstamp validated_ts;
   /* flags is bitwise OR of zero or more of NGTCP2_DCID_FLAG_*. */
   uint8_t flags;
   /* token is a stateless reset token associated to this CID.
@@ -96,6 +111,21 @@ typedef struct ngtcp2_dcid {
   uint8_t token[NGTCP2_STATELESS_RESET_TOKENLEN];
 } ngtcp2_dcid;
 
+#ifndef NOINLINEHELPERS
+/*
+ * ngtcp2_cid_eq_inline is the inline version of ngtcp2_cid_eq which
+ * the library uses in the hot paths.  ngtcp2_cid_eq itself stays
+ * out-of-line because it is a public API.
+ */
+static inline int ngtcp2_cid_eq_inline(const ngtcp2_cid *cid,
+                                       const ngtcp2_cid *other) {
+  return cid->datalen == other->datalen &&
+         0 == memcmp(cid->data, other->data, cid->datalen);
+}
+#else /* NOINLINEHELPERS */
+#  define ngtcp2_cid_eq_inline ngtcp2_cid_eq
+#endif /* NOINLINEHELPERS */
+
 /* ngtcp2_cid_zero makes |cid| zero-length. */
 void ngtcp2_cid_zero(ngtcp2_cid *cid);
 
@@ -142,6 +172,18 @@ void ngtcp2_dcid_set_token(ngtcp2_dcid *dcid, const uint8_t *token);
  */
 void ngtcp2_dcid_set_path(ngtcp2_dcid *dcid, const ngtcp2_path *path);
 
+/*
+ * ngtcp2_dcid_reset_path_stat resets the statistics of the path
+ * associated to |dcid|.
+ */
+void ngtcp2_dcid_reset_path_stat(ngtcp2_dcid *dcid);
+
+/*
+ * ngtcp2_dcid_add_rtt_sample updates RTT of the path associated to
+ * |dcid| with |rtt|.
+ */
+void ngtcp2_dcid_add_rtt_sample(ngtcp2_dcid *dcid, ngtcp2_duration rtt);
+
 /*
  * ngtcp2_dcid_copy copies |src| into |dest|.
  */
@@ -35,6 +35,8 @@
 #include "ngtcp2_addr.h"
 #include "ngtcp2_path.h"
 #include "ngtcp2_rcvry.h"
+#include "ngtcp2_shared_pool.h"
+#include "ngtcp2_probe.h"
 
 /* NGTCP2_FLOW_WINDOW_RTT_FACTOR is the factor of RTT when flow
    control window auto-tuning is triggered. */
@@ -42,16 +44,35 @@
 /* NGTCP2_FLOW_WINDOW_SCALING_FACTOR is the growth factor of flow
    control window. */
 #define NGTCP2_FLOW_WINDOW_SCALING_FACTOR 2
+/* NGTCP2_FLOW_WINDOW_BDP_FACTOR is the factor of the estimated
+   bandwidth-delay product that flow control window is grown to.
+   Because window is refreshed when a half of it is consumed, it must
+   be at least twice the bandwidth-delay product not to stall the
+   remote endpoint. */
+#define NGTCP2_FLOW_WINDOW_BDP_FACTOR 2
 /* NGTCP2_MIN_COALESCED_PAYLOADLEN is the minimum length of QUIC
    packet payload that should be coalesced to a long packet. */
 #define NGTCP2_MIN_COALESCED_PAYLOADLEN 128
 
+/*
+ * conn_is_server returns nonzero if |conn| is server.  If the library
+ * is built for one side only (NOCLIENT or NOSERVER), the result is a
+ * constant, and the compiler removes the branches for the other side.
+ */
+#if defined(NOCLIENT)
+#  define conn_is_server(CONN) ((void)(CONN), 1)
+#elif defined(NOSERVER)
+#  define conn_is_server(CONN) ((void)(CONN), 0)
+#else /* !defined(NOCLIENT) && !defined(NOSERVER) */
+#  define conn_is_server(CONN) ((CONN)->server)
+#endif /* !defined(NOCLIENT) && !defined(NOSERVER) */
+
 /*
  * conn_local_stream returns nonzero if |stream_id| indicates that it
  * is the stream initiated by local endpoint.
  */
 static int conn_local_stream(ngtcp2_conn *conn, int64_t stream_id) {
-  return (uint8_t)(stream_id & 1) == conn->server;
+  return (uint8_t)(stream_id & 1) == conn_is_server(conn);
 }
 
 /*
@@ -158,6 +179,41 @@ static int conn_call_stream_open(ngtcp2_conn *conn, ngtcp2_strm *strm) {
   return 0;
 }
 
+/*
+ * conn_release_stream_bufs calls release_stream_buf callback for each
+ * buffer in |bufs| which is detached from |strm|, and frees them.
+ */
+static void conn_release_stream_bufs(ngtcp2_conn *conn, ngtcp2_strm *strm,
+                                     ngtcp2_strm_buf *bufs) {
+  ngtcp2_strm_buf *next;
+
+  for (; bufs;) {
+    next = bufs->next;
+
+    if (conn->callbacks.release_stream_buf) {
+      conn->callbacks.release_stream_buf(conn, strm->stream_id,
+                                         bufs->buf_user_data, conn->user_data,
+                                         strm->stream_user_data);
+    }
+
+    ngtcp2_strm_buf_del(bufs, conn->mem);
+    bufs = next;
+  }
+}
+
+void ngtcp2_conn_release_acked_stream_bufs(ngtcp2_conn *conn,
+                                           ngtcp2_strm *strm) {
+  if (strm->tx.sendbuf) {
+    ngtcp2_strm_sendbuf_release(strm);
+  }
+
+  if (strm->tx.bufs == NULL) {
+    return;
+  }
+
+  conn_release_stream_bufs(conn, strm, ngtcp2_strm_detach_acked_bufs(strm));
+}
+
 static int conn_call_stream_close(ngtcp2_conn *conn, ngtcp2_strm *strm) {
   int rv;
   uint32_t flags = NGTCP2_STREAM_CLOSE_FLAG_NONE;
@@ -247,6 +303,22 @@ static int conn_call_get_new_connection_id(ngtcp2_conn *conn, ngtcp2_cid *cid,
   return 0;
 }
 
+static int conn_call_get_new_connection_ids(ngtcp2_conn *conn,
+                                            ngtcp2_cid *cids, uint8_t *tokens,
+                                            size_t cidlen, size_t n) {
+  int rv;
+
+  assert(conn->callbacks.get_new_connection_ids);
+
+  rv = conn->callbacks.get_new_connection_ids(conn, cids, tokens, cidlen, n,
+                                              conn->user_data);
+  if (rv != 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+
 static int conn_call_remove_connection_id(ngtcp2_conn *conn,
                                           const ngtcp2_cid *cid) {
   int rv;
@@ -635,15 +707,30 @@ static int conn_call_recv_tx_key(ngtcp2_conn *conn, ngtcp2_crypto_level level) {
   return 0;
 }
 
-static int crypto_offset_less(const ngtcp2_ksl_key *lhs,
-                              const ngtcp2_ksl_key *rhs) {
-  return *(int64_t *)lhs < *(int64_t *)rhs;
+static int conn_call_offload_tx_key(ngtcp2_conn *conn, uint64_t key_id,
+                                    const ngtcp2_crypto_km *ckm) {
+  int rv;
+
+  if (!conn->local.settings.crypto_offload ||
+      !conn->callbacks.offload_tx_key) {
+    return 0;
+  }
+
+  rv = conn->callbacks.offload_tx_key(conn, key_id, ckm->secret.base,
+                                      ckm->secret.len, conn->user_data);
+  if (rv != 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
 }
 
 static int pktns_init(ngtcp2_pktns *pktns, ngtcp2_pktns_id pktns_id,
                       ngtcp2_rst *rst, ngtcp2_cc *cc, ngtcp2_log *log,
                       ngtcp2_qlog *qlog, ngtcp2_objalloc *rtb_entry_objalloc,
                       ngtcp2_objalloc *frc_objalloc, const ngtcp2_mem *mem) {
+  const ngtcp2_mem *crypto_mem =
+      ngtcp2_mem_for_subsys(mem, NGTCP2_MEM_SUBSYS_CRYPTO);
   int rv;
 
   memset(pktns, 0, sizeof(*pktns));
@@ -653,6 +740,7 @@ static int pktns_init(ngtcp2_pktns *pktns, ngtcp2_pktns_id pktns_id,
   pktns->tx.last_pkt_num = -1;
   pktns->rx.max_pkt_num = -1;
   pktns->rx.max_ack_eliciting_pkt_num = -1;
+  pktns->tx.ack.acktr_gen = UINT64_MAX;
 
   rv = ngtcp2_acktr_init(&pktns->acktr, log, mem);
   if (rv != 0) {
@@ -660,10 +748,9 @@ static int pktns_init(ngtcp2_pktns *pktns, ngtcp2_pktns_id pktns_id,
   }
 
   ngtcp2_strm_init(&pktns->crypto.strm, 0, NGTCP2_STRM_FLAG_NONE, 0, 0, NULL,
-                   NULL, mem);
+                   NULL, crypto_mem);
 
-  ngtcp2_ksl_init(&pktns->crypto.tx.frq, crypto_offset_less, sizeof(uint64_t),
-                  mem);
+  ngtcp2_cryptofrq_init(&pktns->crypto.tx.frq);
 
   ngtcp2_rtb_init(&pktns->rtb, pktns_id, &pktns->crypto.strm, rst, cc, log,
                   qlog, rtb_entry_objalloc, frc_objalloc, mem);
@@ -707,14 +794,54 @@ static int cycle_less(const ngtcp2_pq_entry *lhs, const ngtcp2_pq_entry *rhs) {
   return rs->cycle - ls->cycle <= 1;
 }
 
-static void delete_buffed_pkts(ngtcp2_pkt_chain *pc, const ngtcp2_mem *mem) {
-  ngtcp2_pkt_chain *next;
+/*
+ * urgency_cycle_less orders the streams by urgency first, and then by
+ * cycle_less.  It is used for
+ * NGTCP2_SCHED_POLICY_STRICT_PRIORITY.
+ */
+static int urgency_cycle_less(const ngtcp2_pq_entry *lhs,
+                              const ngtcp2_pq_entry *rhs) {
+  ngtcp2_strm *ls = ngtcp2_struct_of(lhs, ngtcp2_strm, pe);
+  ngtcp2_strm *rs = ngtcp2_struct_of(rhs, ngtcp2_strm, pe);
 
-  for (; pc;) {
-    next = pc->next;
-    ngtcp2_pkt_chain_del(pc, mem);
-    pc = next;
+  if (ls->sched.urgency != rs->sched.urgency) {
+    return ls->sched.urgency < rs->sched.urgency;
   }
+
+  return cycle_less(lhs, rhs);
+}
+
+static uint64_t strm_cycle(const ngtcp2_pq_entry *ent) {
+  return ngtcp2_struct_of(ent, ngtcp2_strm, pe)->cycle;
+}
+
+/*
+ * conn_tx_strmq_use_pq returns nonzero if tx_strmq is conn->tx.strmq
+ * rather than conn->tx.strmcq.
+ */
+static int conn_tx_strmq_use_pq(ngtcp2_conn *conn) {
+  return conn->local.settings.sched_policy ==
+         NGTCP2_SCHED_POLICY_STRICT_PRIORITY;
+}
+
+/*
+ * conn_retransmit_first returns nonzero if new data must not be sent
+ * because the lost stream data are waiting to be sent and
+ * ngtcp2_settings.retransmit_first is set.
+ */
+static int conn_retransmit_first(ngtcp2_conn *conn) {
+  return conn->local.settings.retransmit_first && conn->tx.strmq_nretrans;
+}
+
+/*
+ * delete_buffed_pkts drops the packets buffered in |pktns|, and frees
+ * the buffer which they are stored in.
+ */
+static void delete_buffed_pkts(ngtcp2_pktns *pktns, const ngtcp2_mem *mem) {
+  pktns->rx.buffed_pkts = NULL;
+
+  ngtcp2_mem_free(mem, pktns->rx.buffed_pkts_buf.begin);
+  ngtcp2_buf_init(&pktns->rx.buffed_pkts_buf, NULL, 0);
 }
 
 static void delete_buf_chain(ngtcp2_buf_chain *bufchain,
@@ -729,12 +856,9 @@ static void delete_buf_chain(ngtcp2_buf_chain *bufchain,
 }
 
 static void pktns_free(ngtcp2_pktns *pktns, const ngtcp2_mem *mem) {
-  ngtcp2_frame_chain *frc;
-  ngtcp2_ksl_it it;
-
   delete_buf_chain(pktns->crypto.tx.data, mem);
 
-  delete_buffed_pkts(pktns->rx.buffed_pkts, mem);
+  delete_buffed_pkts(pktns, mem);
 
   ngtcp2_frame_chain_list_objalloc_del(pktns->tx.frq, pktns->rtb.frc_objalloc,
                                        mem);
@@ -742,17 +866,12 @@ static void pktns_free(ngtcp2_pktns *pktns, const ngtcp2_mem *mem) {
   ngtcp2_crypto_km_del(pktns->crypto.rx.ckm, mem);
   ngtcp2_crypto_km_del(pktns->crypto.tx.ckm, mem);
 
-  for (it = ngtcp2_ksl_begin(&pktns->crypto.tx.frq); !ngtcp2_ksl_it_end(&it);
-       ngtcp2_ksl_it_next(&it)) {
-    frc = ngtcp2_ksl_it_get(&it);
-    ngtcp2_frame_chain_objalloc_del(frc, pktns->rtb.frc_objalloc, mem);
-  }
-
-  ngtcp2_ksl_free(&pktns->crypto.tx.frq);
+  ngtcp2_cryptofrq_clear(&pktns->crypto.tx.frq, pktns->rtb.frc_objalloc, mem);
   ngtcp2_rtb_free(&pktns->rtb);
   ngtcp2_strm_free(&pktns->crypto.strm);
   ngtcp2_acktr_free(&pktns->acktr);
   ngtcp2_gaptr_free(&pktns->rx.pngap);
+  ngtcp2_mem_free(mem, pktns->tx.ack.fr);
 }
 
 static void pktns_del(ngtcp2_pktns *pktns, const ngtcp2_mem *mem) {
@@ -780,6 +899,9 @@ static void cc_del(ngtcp2_cc *cc, ngtcp2_cc_algo cc_algo,
   case NGTCP2_CC_ALGO_BBR2:
     ngtcp2_cc_bbr2_cc_free(cc, mem);
     break;
+  case NGTCP2_CC_ALGO_PRAGUE:
+    ngtcp2_cc_prague_cc_free(cc, mem);
+    break;
   default:
     break;
   }
@@ -817,6 +939,11 @@ static void conn_reset_conn_stat_cc(ngtcp2_conn *conn,
   cstat->delivery_rate_sec = 0;
   cstat->pacing_rate = 0.0;
   cstat->send_quantum = SIZE_MAX;
+  cstat->ss_exit_reason = NGTCP2_SS_EXIT_REASON_NONE;
+  cstat->ss_exit_ts = UINT64_MAX;
+  cstat->ss_exit_cwnd = 0;
+  cstat->hystart_css_count = 0;
+  cstat->hystart_css_spurious_count = 0;
 }
 
 /*
@@ -838,6 +965,22 @@ static void conn_reset_conn_stat(ngtcp2_conn *conn, ngtcp2_conn_stat *cstat) {
   reset_conn_stat_recovery(cstat);
 }
 
+/*
+ * conn_publish_conn_stat copies conn->cstat to conn->published so
+ * that the other threads can read it.
+ */
+static void conn_publish_conn_stat(ngtcp2_conn *conn) {
+  ngtcp2_conn_published_stat *published = conn->published;
+
+  if (!published) {
+    return;
+  }
+
+  ngtcp2_seqlock_write_begin(&published->lock);
+  published->cstat = conn->cstat;
+  ngtcp2_seqlock_write_end(&published->lock);
+}
+
 static void delete_scid(ngtcp2_ksl *scids, const ngtcp2_mem *mem) {
   ngtcp2_ksl_it it;
 
@@ -915,7 +1058,11 @@ static void conn_handle_tx_ecn(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
       *prtb_entry_flags |= NGTCP2_RTB_ENTRY_FLAG_ECN;
     }
 
-    ++pktns->tx.ecn.ect0;
+    if (pi->ecn == NGTCP2_ECN_ECT_1) {
+      ++pktns->tx.ecn.ect1;
+    } else {
+      ++pktns->tx.ecn.ect0;
+    }
 
     return;
   }
@@ -947,13 +1094,18 @@ static void conn_handle_tx_ecn(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
     /* pi is provided per UDP datagram. */
     assert(NGTCP2_ECN_NOT_ECT == pi->ecn);
 
-    pi->ecn = NGTCP2_ECN_ECT_0;
-
     if (prtb_entry_flags) {
       *prtb_entry_flags |= NGTCP2_RTB_ENTRY_FLAG_ECN;
     }
 
-    ++pktns->tx.ecn.ect0;
+    /* L4S congestion control identifies itself with ECT(1). */
+    if (conn->cc_algo == NGTCP2_CC_ALGO_PRAGUE) {
+      pi->ecn = NGTCP2_ECN_ECT_1;
+      ++pktns->tx.ecn.ect1;
+    } else {
+      pi->ecn = NGTCP2_ECN_ECT_0;
+      ++pktns->tx.ecn.ect0;
+    }
     break;
   case NGTCP2_ECN_STATE_UNKNOWN:
   case NGTCP2_ECN_STATE_FAILED:
@@ -1035,7 +1187,7 @@ conn_set_local_transport_params(ngtcp2_conn *conn,
   /* grease_quic_bit is always enabled. */
   p->grease_quic_bit = 1;
 
-  if (conn->server) {
+  if (conn_is_server(conn)) {
     p->version_info.chosen_version = chosen_version;
   } else {
     p->version_info.chosen_version = conn->client_chosen_version;
@@ -1045,6 +1197,25 @@ conn_set_local_transport_params(ngtcp2_conn *conn,
   p->version_info_present = 1;
 }
 
+/*
+ * conn_cc_resume_supported returns nonzero if the congestion
+ * controller of |conn| supports Careful Resume.
+ */
+static int conn_cc_resume_supported(ngtcp2_conn *conn) {
+  if (conn->flags & NGTCP2_CONN_FLAG_USER_CC) {
+    return 0;
+  }
+
+  switch (conn->cc_algo) {
+  case NGTCP2_CC_ALGO_RENO:
+  case NGTCP2_CC_ALGO_CUBIC:
+  case NGTCP2_CC_ALGO_PRAGUE:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
 static int conn_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
                     const ngtcp2_cid *scid, const ngtcp2_path *path,
                     uint32_t client_chosen_version, int callbacks_version,
@@ -1057,14 +1228,26 @@ static int conn_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
   ngtcp2_scid *scident;
   uint8_t *buf;
   uint8_t fixed_bit_byte;
+  uint8_t spin_byte;
   size_t i;
   uint32_t *preferred_versions;
   (void)callbacks_version;
   (void)settings_version;
   (void)transport_params_version;
 
+#if defined(NOCLIENT)
+  if (!server) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+#elif defined(NOSERVER)
+  if (server) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+#endif /* defined(NOSERVER) */
+
   assert(settings->max_window <= NGTCP2_MAX_VARINT);
   assert(settings->max_stream_window <= NGTCP2_MAX_VARINT);
+  assert(settings->max_streams_window <= NGTCP2_MAX_STREAMS);
   assert(settings->max_udp_payload_size);
   assert(settings->max_udp_payload_size <= NGTCP2_HARD_MAX_UDP_PAYLOAD_SIZE);
   assert(params->active_connection_id_limit <= NGTCP2_MAX_DCID_POOL_SIZE);
@@ -1080,7 +1263,7 @@ static int conn_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
   assert(callbacks->hp_mask);
   assert(server || callbacks->recv_retry);
   assert(callbacks->rand);
-  assert(callbacks->get_new_connection_id);
+  assert(callbacks->get_new_connection_id || callbacks->get_new_connection_ids);
   assert(callbacks->update_key);
   assert(callbacks->delete_crypto_aead_ctx);
   assert(callbacks->delete_crypto_cipher_ctx);
@@ -1097,9 +1280,31 @@ static int conn_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
     goto fail_conn;
   }
 
-  ngtcp2_objalloc_frame_chain_init(&(*pconn)->frc_objalloc, 64, mem);
-  ngtcp2_objalloc_rtb_entry_init(&(*pconn)->rtb_entry_objalloc, 64, mem);
-  ngtcp2_objalloc_strm_init(&(*pconn)->strm_objalloc, 64, mem);
+  ngtcp2_mem_acct_init(&(*pconn)->mem_acct, mem);
+
+  /* The accounting allocator adds a header and an indirect call to
+     each allocation.  Only pay for it if the budget needs it. */
+  if (settings->mem_budget) {
+    mem = ngtcp2_mem_acct_get(&(*pconn)->mem_acct, NGTCP2_MEM_SUBSYS_OTHER);
+  }
+
+  ngtcp2_objalloc_frame_chain_init(&(*pconn)->objalloc.frc,
+                                   NGTCP2_CONN_OBJALLOC_NMEMB, mem);
+  ngtcp2_objalloc_rtb_entry_init(&(*pconn)->objalloc.rtb_entry,
+                                 NGTCP2_CONN_OBJALLOC_NMEMB, mem);
+  ngtcp2_objalloc_strm_init(&(*pconn)->objalloc.strm,
+                            NGTCP2_CONN_OBJALLOC_NMEMB, mem);
+
+  if (settings->shared_pool) {
+    (*pconn)->frc_objalloc = &settings->shared_pool->frc;
+    (*pconn)->rtb_entry_objalloc = &settings->shared_pool->rtb_entry;
+    (*pconn)->strm_objalloc = &settings->shared_pool->strm;
+  } else {
+    (*pconn)->frc_objalloc = &(*pconn)->objalloc.frc;
+    (*pconn)->rtb_entry_objalloc = &(*pconn)->objalloc.rtb_entry;
+    (*pconn)->strm_objalloc = &(*pconn)->objalloc.strm;
+  }
+  ngtcp2_strm_pool_init(&(*pconn)->strm_pool);
 
   ngtcp2_static_ringbuf_dcid_bound_init(&(*pconn)->dcid.bound);
 
@@ -1115,7 +1320,11 @@ static int conn_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
 
   ngtcp2_map_init(&(*pconn)->strms, mem);
 
-  ngtcp2_pq_init(&(*pconn)->tx.strmq, cycle_less, mem);
+  ngtcp2_pq_init_arity(&(*pconn)->tx.strmq, urgency_cycle_less, 4, mem);
+
+  ngtcp2_cycleq_init(&(*pconn)->tx.strmcq, strm_cycle, cycle_less, mem);
+
+  ngtcp2_sched_init(&(*pconn)->tx.sched, settings->sched_policy, mem);
 
   ngtcp2_idtr_init(&(*pconn)->remote.bidi.idtr, !server, mem);
 
@@ -1124,8 +1333,8 @@ static int conn_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
   ngtcp2_static_ringbuf_path_challenge_init(&(*pconn)->rx.path_challenge);
 
   ngtcp2_log_init(&(*pconn)->log, scid, settings->log_printf,
-                  settings->initial_ts, user_data);
-  ngtcp2_qlog_init(&(*pconn)->qlog, settings->qlog.write, settings->initial_ts,
+                  settings->log_record, settings->initial_ts, user_data);
+  ngtcp2_qlog_init(&(*pconn)->qlog, &settings->qlog, settings->initial_ts,
                    user_data);
   if ((*pconn)->qlog.write) {
     buf = ngtcp2_mem_malloc(mem, NGTCP2_QLOG_BUFLEN);
@@ -1136,8 +1345,30 @@ static int conn_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
     ngtcp2_buf_init(&(*pconn)->qlog.buf, buf, NGTCP2_QLOG_BUFLEN);
   }
 
+  if (settings->publish_conn_stat) {
+    (*pconn)->published =
+        ngtcp2_mem_malloc(mem, sizeof(*(*pconn)->published));
+    if ((*pconn)->published == NULL) {
+      rv = NGTCP2_ERR_NOMEM;
+      goto fail_published;
+    }
+    ngtcp2_seqlock_init(&(*pconn)->published->lock);
+  }
+
+  if (settings->latency_stat) {
+    (*pconn)->latency =
+        ngtcp2_mem_calloc(mem, 1, sizeof(*(*pconn)->latency));
+    if ((*pconn)->latency == NULL) {
+      rv = NGTCP2_ERR_NOMEM;
+      goto fail_latency;
+    }
+  }
+
   (*pconn)->local.settings = *settings;
 
+  ngtcp2_perf_init(&(*pconn)->perf, settings->perf_stat);
+  ngtcp2_stall_init(&(*pconn)->stall);
+
   if (settings->token.len) {
     buf = ngtcp2_mem_malloc(mem, settings->token.len);
     if (buf == NULL) {
@@ -1159,6 +1390,7 @@ static int conn_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
   (*pconn)->cstat.initial_rtt = settings->initial_rtt;
   (*pconn)->cstat.max_udp_payload_size =
       (*pconn)->local.settings.max_udp_payload_size;
+  (*pconn)->pmtud_bh.max_ack_pkt_num = -1;
 
   ngtcp2_rst_init(&(*pconn)->rst);
 
@@ -1166,13 +1398,17 @@ static int conn_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
 
   switch (settings->cc_algo) {
   case NGTCP2_CC_ALGO_RENO:
-    rv = ngtcp2_cc_reno_cc_init(&(*pconn)->cc, &(*pconn)->log, mem);
+    rv = ngtcp2_cc_reno_cc_init(&(*pconn)->cc, &(*pconn)->log,
+                                settings->hystart, settings->cwnd_validation,
+                                mem);
     if (rv != 0) {
       goto fail_cc_init;
     }
     break;
   case NGTCP2_CC_ALGO_CUBIC:
-    rv = ngtcp2_cc_cubic_cc_init(&(*pconn)->cc, &(*pconn)->log, mem);
+    rv = ngtcp2_cc_cubic_cc_init(&(*pconn)->cc, &(*pconn)->log,
+                                 settings->hystart, settings->cwnd_validation,
+                                 mem);
     if (rv != 0) {
       goto fail_cc_init;
     }
@@ -1193,27 +1429,44 @@ static int conn_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
       goto fail_cc_init;
     }
     break;
+  case NGTCP2_CC_ALGO_PRAGUE:
+    rv = ngtcp2_cc_prague_cc_init(&(*pconn)->cc, &(*pconn)->log,
+                                  settings->hystart, settings->cwnd_validation,
+                                  mem);
+    if (rv != 0) {
+      goto fail_cc_init;
+    }
+    break;
   default:
     assert(0);
   }
 
+  ngtcp2_path_storage_init2(&(*pconn)->cc_resume.ps, path);
+
+  if (conn_cc_resume_supported(*pconn) && settings->cc_resume.cwnd &&
+      settings->cc_resume.min_rtt &&
+      settings->cc_resume.min_rtt != UINT64_MAX) {
+    (*pconn)->cc_resume.params = settings->cc_resume;
+    (*pconn)->cc_resume.phase = NGTCP2_CC_RESUME_PHASE_RECONNAISSANCE;
+  }
+
   rv = pktns_new(&(*pconn)->in_pktns, NGTCP2_PKTNS_ID_INITIAL, &(*pconn)->rst,
                  &(*pconn)->cc, &(*pconn)->log, &(*pconn)->qlog,
-                 &(*pconn)->rtb_entry_objalloc, &(*pconn)->frc_objalloc, mem);
+                 (*pconn)->rtb_entry_objalloc, (*pconn)->frc_objalloc, mem);
   if (rv != 0) {
     goto fail_in_pktns_init;
   }
 
   rv = pktns_new(&(*pconn)->hs_pktns, NGTCP2_PKTNS_ID_HANDSHAKE, &(*pconn)->rst,
                  &(*pconn)->cc, &(*pconn)->log, &(*pconn)->qlog,
-                 &(*pconn)->rtb_entry_objalloc, &(*pconn)->frc_objalloc, mem);
+                 (*pconn)->rtb_entry_objalloc, (*pconn)->frc_objalloc, mem);
   if (rv != 0) {
     goto fail_hs_pktns_init;
   }
 
   rv = pktns_init(&(*pconn)->pktns, NGTCP2_PKTNS_ID_APPLICATION, &(*pconn)->rst,
                   &(*pconn)->cc, &(*pconn)->log, &(*pconn)->qlog,
-                  &(*pconn)->rtb_entry_objalloc, &(*pconn)->frc_objalloc, mem);
+                  (*pconn)->rtb_entry_objalloc, (*pconn)->frc_objalloc, mem);
   if (rv != 0) {
     goto fail_pktns_init;
   }
@@ -1330,6 +1583,18 @@ static int conn_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
     (*pconn)->flags |= NGTCP2_CONN_FLAG_CLEAR_FIXED_BIT;
   }
 
+  callbacks->rand(&(*pconn)->crypto.key_update.jitter, 1,
+                  &settings->rand_ctx);
+
+  /* The spin bit is disabled for 1 in 16 connections even if it is
+     enabled by settings (RFC 9000 section 17.4). */
+  callbacks->rand(&spin_byte, 1, &settings->rand_ctx);
+  if (settings->spin_bit && (spin_byte & 0xf)) {
+    (*pconn)->flags |= NGTCP2_CONN_FLAG_SPIN_BIT;
+  } else {
+    (*pconn)->spin.value = (spin_byte >> 4) & 1;
+  }
+
   (*pconn)->keep_alive.last_ts = UINT64_MAX;
 
   (*pconn)->server = server;
@@ -1340,7 +1605,13 @@ static int conn_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
   (*pconn)->idle_ts = settings->initial_ts;
   (*pconn)->crypto.key_update.confirmed_ts = UINT64_MAX;
   (*pconn)->tx.last_max_data_ts = UINT64_MAX;
+  (*pconn)->tx.flow_update.first_ts = UINT64_MAX;
   (*pconn)->tx.pacing.next_ts = UINT64_MAX;
+  (*pconn)->tx.ack_freq.last_ts = UINT64_MAX;
+  (*pconn)->tx.ampl_blocked_ts = UINT64_MAX;
+  (*pconn)->rx.ack_freq.ack_thresh = settings->ack_thresh;
+  (*pconn)->rx.ack_freq.max_ack_delay = UINT64_MAX;
+  (*pconn)->rx.ack_freq.reordering_thresh = 1;
   (*pconn)->early.discard_started_ts = UINT64_MAX;
 
   conn_reset_ecn_validation_state(*pconn);
@@ -1348,6 +1619,8 @@ static int conn_new(ngtcp2_conn **pconn, const ngtcp2_cid *dcid,
   ngtcp2_qlog_start(&(*pconn)->qlog, server ? &settings->qlog.odcid : dcid,
                     server);
 
+  conn_publish_conn_stat(*pconn);
+
   return 0;
 
 fail_other_versions:
@@ -1367,6 +1640,10 @@ fail_in_pktns_init:
 fail_cc_init:
   ngtcp2_mem_free(mem, (*pconn)->local.settings.token.base);
 fail_token:
+  ngtcp2_mem_free(mem, (*pconn)->latency);
+fail_latency:
+  ngtcp2_mem_free(mem, (*pconn)->published);
+fail_published:
   ngtcp2_mem_free(mem, (*pconn)->qlog.buf.begin);
 fail_qlog_buf:
   ngtcp2_idtr_free(&(*pconn)->remote.uni.idtr);
@@ -1375,10 +1652,10 @@ fail_qlog_buf:
   delete_scid(&(*pconn)->scid.set, mem);
   ngtcp2_ksl_free(&(*pconn)->scid.set);
   ngtcp2_gaptr_free(&(*pconn)->dcid.seqgap);
-  ngtcp2_objalloc_free(&(*pconn)->strm_objalloc);
-  ngtcp2_objalloc_free(&(*pconn)->rtb_entry_objalloc);
-  ngtcp2_objalloc_free(&(*pconn)->frc_objalloc);
-  ngtcp2_mem_free(mem, *pconn);
+  ngtcp2_objalloc_free(&(*pconn)->objalloc.strm);
+  ngtcp2_objalloc_free(&(*pconn)->objalloc.rtb_entry);
+  ngtcp2_objalloc_free(&(*pconn)->objalloc.frc);
+  ngtcp2_mem_free((*pconn)->mem_acct.mem, *pconn);
 fail_conn:
   return rv;
 }
@@ -1435,6 +1712,7 @@ int ngtcp2_conn_server_new_versioned(
   if ((*pconn)->local.settings.token.len) {
     /* Usage of token lifts amplification limit */
     (*pconn)->dcid.current.flags |= NGTCP2_DCID_FLAG_PATH_VALIDATED;
+    (*pconn)->dcid.current.validated_ts = (*pconn)->local.settings.initial_ts;
   }
 
   return 0;
@@ -1465,8 +1743,9 @@ static int delete_strms_each(void *data, void *ptr) {
   ngtcp2_conn *conn = ptr;
   ngtcp2_strm *s = data;
 
+  conn_release_stream_bufs(conn, s, ngtcp2_strm_detach_bufs(s));
   ngtcp2_strm_free(s);
-  ngtcp2_objalloc_strm_release(&conn->strm_objalloc, s);
+  ngtcp2_objalloc_strm_release(conn->strm_objalloc, s);
 
   return 0;
 }
@@ -1487,12 +1766,21 @@ static void conn_vneg_crypto_free(ngtcp2_conn *conn) {
 }
 
 void ngtcp2_conn_del(ngtcp2_conn *conn) {
+  ngtcp2_dgram_entry *dgent;
+
   if (conn == NULL) {
     return;
   }
 
   ngtcp2_qlog_end(&conn->qlog);
 
+  /* Application must release all jobs before deleting the
+     connection.  Release the leftovers anyway so that the discarded
+     keys which they refer to are not leaked. */
+  for (; conn->protect_jobs;) {
+    ngtcp2_conn_release_protect_job(conn, conn->protect_jobs);
+  }
+
   if (conn->early.ckm) {
     conn_call_delete_crypto_aead_ctx(conn, &conn->early.ckm->aead_ctx);
   }
@@ -1552,8 +1840,10 @@ void ngtcp2_conn_del(ngtcp2_conn *conn) {
 
   conn_call_delete_crypto_aead_ctx(conn, &conn->crypto.retry_aead_ctx);
 
-  ngtcp2_transport_params_del(conn->remote.transport_params, conn->mem);
-  ngtcp2_transport_params_del(conn->remote.pending_transport_params, conn->mem);
+  ngtcp2_transport_params_storage_free(
+      &conn->remote.transport_params_storage[0], conn->mem);
+  ngtcp2_transport_params_storage_free(
+      &conn->remote.transport_params_storage[1], conn->mem);
 
   conn_vneg_crypto_free(conn);
 
@@ -1565,17 +1855,34 @@ void ngtcp2_conn_del(ngtcp2_conn *conn) {
   ngtcp2_mem_free(conn->mem, conn->crypto.decrypt_buf.base);
   ngtcp2_mem_free(conn->mem, conn->crypto.decrypt_hp_buf.base);
   ngtcp2_mem_free(conn->mem, conn->local.settings.token.base);
+  ngtcp2_mem_free(conn->mem, conn->protect);
+  ngtcp2_mem_free(conn->mem, conn->rx_hp);
+  ngtcp2_mem_free(conn->mem, conn->published);
+  ngtcp2_mem_free(conn->mem, conn->latency);
 
   ngtcp2_crypto_km_del(conn->crypto.key_update.old_rx_ckm, conn->mem);
   ngtcp2_crypto_km_del(conn->crypto.key_update.new_rx_ckm, conn->mem);
   ngtcp2_crypto_km_del(conn->crypto.key_update.new_tx_ckm, conn->mem);
   ngtcp2_crypto_km_del(conn->early.ckm, conn->mem);
 
+  ngtcp2_frame_chain_list_objalloc_del(conn->tx.repairq, conn->frc_objalloc,
+                                      conn->mem);
+
+  for (; conn->tx.dgramq;) {
+    dgent = conn->tx.dgramq;
+    conn->tx.dgramq = dgent->next;
+    ngtcp2_mem_free(conn->mem, dgent);
+  }
+
   pktns_free(&conn->pktns, conn->mem);
   pktns_del(conn->hs_pktns, conn->mem);
   pktns_del(conn->in_pktns, conn->mem);
 
-  cc_del(&conn->cc, conn->cc_algo, conn->mem);
+  if (conn->flags & NGTCP2_CONN_FLAG_USER_CC) {
+    ngtcp2_cc_user_cc_free(&conn->cc, conn->mem);
+  } else {
+    cc_del(&conn->cc, conn->cc_algo, conn->mem);
+  }
 
   ngtcp2_mem_free(conn->mem, conn->qlog.buf.begin);
 
@@ -1586,26 +1893,28 @@ void ngtcp2_conn_del(ngtcp2_conn *conn) {
 
   ngtcp2_idtr_free(&conn->remote.uni.idtr);
   ngtcp2_idtr_free(&conn->remote.bidi.idtr);
-  ngtcp2_mem_free(conn->mem, conn->tx.ack);
   ngtcp2_pq_free(&conn->tx.strmq);
+  ngtcp2_cycleq_free(&conn->tx.strmcq);
+  ngtcp2_sched_free(&conn->tx.sched);
   ngtcp2_map_each_free(&conn->strms, delete_strms_each, (void *)conn);
   ngtcp2_map_free(&conn->strms);
+  ngtcp2_strm_pool_free(&conn->strm_pool, conn->mem);
 
   ngtcp2_pq_free(&conn->scid.used);
   delete_scid(&conn->scid.set, conn->mem);
   ngtcp2_ksl_free(&conn->scid.set);
   ngtcp2_gaptr_free(&conn->dcid.seqgap);
 
-  ngtcp2_objalloc_free(&conn->strm_objalloc);
-  ngtcp2_objalloc_free(&conn->rtb_entry_objalloc);
-  ngtcp2_objalloc_free(&conn->frc_objalloc);
+  ngtcp2_objalloc_free(&conn->objalloc.strm);
+  ngtcp2_objalloc_free(&conn->objalloc.rtb_entry);
+  ngtcp2_objalloc_free(&conn->objalloc.frc);
 
-  ngtcp2_mem_free(conn->mem, conn);
+  ngtcp2_mem_free(conn->mem_acct.mem, conn);
 }
 
 /*
- * conn_ensure_ack_blks makes sure that conn->tx.ack->ack.blks can
- * contain at least |n| additional ngtcp2_ack_blk.
+ * pktns_ensure_ack_blks makes sure that pktns->tx.ack.fr->ack.blks
+ * can contain at least |n| additional ngtcp2_ack_blk.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -1613,9 +1922,10 @@ void ngtcp2_conn_del(ngtcp2_conn *conn) {
  * NGTCP2_ERR_NOMEM
  *     Out of memory.
  */
-static int conn_ensure_ack_blks(ngtcp2_conn *conn, size_t n) {
+static int pktns_ensure_ack_blks(ngtcp2_pktns *pktns, size_t n,
+                                 const ngtcp2_mem *mem) {
   ngtcp2_frame *fr;
-  size_t max = conn->tx.max_ack_blks;
+  size_t max = pktns->tx.ack.max_blks;
 
   if (n <= max) {
     return 0;
@@ -1625,27 +1935,126 @@ static int conn_ensure_ack_blks(ngtcp2_conn *conn, size_t n) {
 
   assert(max >= n);
 
-  fr = ngtcp2_mem_realloc(conn->mem, conn->tx.ack,
+  fr = ngtcp2_mem_realloc(mem, pktns->tx.ack.fr,
                           sizeof(ngtcp2_ack) + sizeof(ngtcp2_ack_blk) * max);
   if (fr == NULL) {
     return NGTCP2_ERR_NOMEM;
   }
 
-  conn->tx.ack = fr;
-  conn->tx.max_ack_blks = max;
+  pktns->tx.ack.fr = fr;
+  pktns->tx.ack.max_blks = max;
 
   return 0;
 }
 
 /*
  * conn_compute_ack_delay computes ACK delay for outgoing protected
- * ACK.
+ * ACK.  If the remote endpoint has requested max_ack_delay with
+ * ACK_FREQUENCY frame, it is used as is.
  */
 static ngtcp2_duration conn_compute_ack_delay(ngtcp2_conn *conn) {
+  if (conn->rx.ack_freq.max_ack_delay != UINT64_MAX) {
+    return conn->rx.ack_freq.max_ack_delay;
+  }
+
   return ngtcp2_min(conn->local.transport_params.max_ack_delay,
                     conn->cstat.smoothed_rtt / 8);
 }
 
+/*
+ * pktns_build_ack_blks builds the largest acknowledged packet and
+ * ACK blocks of pktns->tx.ack.fr from pktns->acktr, and records the
+ * generation of pktns->acktr so that they can be reused.
+ * pktns->acktr must not be empty.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ */
+static int pktns_build_ack_blks(ngtcp2_pktns *pktns, const ngtcp2_mem *mem) {
+  int64_t last_pkt_num;
+  ngtcp2_acktr *acktr = &pktns->acktr;
+  ngtcp2_ack_blk *blk;
+  ngtcp2_acktr_entry *rpkt;
+  ngtcp2_ack *ack = &pktns->tx.ack.fr->ack;
+  size_t blk_idx;
+  size_t i = 0, len = ngtcp2_acktr_len(acktr);
+  int rv;
+
+  pktns->tx.ack.acktr_gen = UINT64_MAX;
+
+  assert(len);
+
+  ack->num_blks = 0;
+
+  rpkt = ngtcp2_acktr_get(acktr, 0);
+
+  if (rpkt->pkt_num == pktns->rx.max_pkt_num) {
+    last_pkt_num = rpkt->pkt_num - (int64_t)(rpkt->len - 1);
+    pktns->tx.ack.largest_ack_ts = rpkt->tstamp;
+    ack->largest_ack = rpkt->pkt_num;
+    ack->first_ack_blklen = rpkt->len - 1;
+
+    ++i;
+  } else {
+    assert(rpkt->pkt_num < pktns->rx.max_pkt_num);
+
+    last_pkt_num = pktns->rx.max_pkt_num;
+    pktns->tx.ack.largest_ack_ts = pktns->rx.max_pkt_ts;
+    ack->largest_ack = pktns->rx.max_pkt_num;
+    ack->first_ack_blklen = 0;
+  }
+
+  for (; i < len; ++i) {
+    if (ack->num_blks == NGTCP2_MAX_ACK_BLKS) {
+      break;
+    }
+
+    rpkt = ngtcp2_acktr_get(acktr, i);
+
+    blk_idx = ack->num_blks++;
+    rv = pktns_ensure_ack_blks(pktns, ack->num_blks, mem);
+    if (rv != 0) {
+      return rv;
+    }
+    ack = &pktns->tx.ack.fr->ack;
+    blk = &ack->blks[blk_idx];
+    blk->gap = (uint64_t)(last_pkt_num - rpkt->pkt_num - 2);
+    blk->blklen = rpkt->len - 1;
+
+    last_pkt_num = rpkt->pkt_num - (int64_t)(rpkt->len - 1);
+  }
+
+  /* TODO Just remove entries which cannot fit into a single ACK frame
+     for now. */
+  if (i < len) {
+    ngtcp2_acktr_forget(acktr, i);
+  }
+
+  pktns->tx.ack.acktr_gen = acktr->gen;
+
+  return 0;
+}
+
+/*
+ * conn_record_ack_delay records the time since the ack-eliciting
+ * packet that |acktr| has not acknowledged yet was received, when an
+ * ACK frame is sent at |ts|.
+ */
+static void conn_record_ack_delay(ngtcp2_conn *conn,
+                                  const ngtcp2_acktr *acktr,
+                                  ngtcp2_tstamp ts) {
+  if (!conn->latency || acktr->first_unacked_ts == UINT64_MAX ||
+      acktr->first_unacked_ts > ts) {
+    return;
+  }
+
+  ngtcp2_latency_hist_add(&conn->latency->ack_delay,
+                          ts - acktr->first_unacked_ts);
+}
+
 /*
  * conn_create_ack_frame creates ACK frame, and assigns its pointer to
  * |*pfr| if there are any received packets to acknowledge.  If there
@@ -1654,8 +2063,10 @@ static ngtcp2_duration conn_compute_ack_delay(ngtcp2_conn *conn) {
  * calling this function, and check it after this function returns.
  * If |nodelay| is nonzero, delayed ACK timer is ignored.
  *
- * The memory for ACK frame is dynamically allocated by this function.
- * A caller is responsible to free it.
+ * The memory for ACK frame is owned by |pktns|, and it is reused
+ * across calls.  ACK blocks are rebuilt only if pktns->acktr has
+ * changed other than extending the largest range; otherwise only the
+ * first ACK range, ACK Delay, and ECN counts are updated.
  *
  * Call ngtcp2_acktr_commit_ack after a created ACK frame is
  * successfully serialized into a packet.
@@ -1673,14 +2084,9 @@ static int conn_create_ack_frame(ngtcp2_conn *conn, ngtcp2_frame **pfr,
   /* TODO Measure an actual size of ACK blocks to find the best
      default value. */
   const size_t initial_max_ack_blks = 8;
-  int64_t last_pkt_num;
   ngtcp2_acktr *acktr = &pktns->acktr;
-  ngtcp2_ack_blk *blk;
-  ngtcp2_ksl_it it;
   ngtcp2_acktr_entry *rpkt;
   ngtcp2_ack *ack;
-  size_t blk_idx;
-  ngtcp2_tstamp largest_ack_ts;
   int rv;
 
   if (acktr->flags & NGTCP2_ACKTR_FLAG_IMMEDIATE_ACK) {
@@ -1691,23 +2097,41 @@ static int conn_create_ack_frame(ngtcp2_conn *conn, ngtcp2_frame **pfr,
     return 0;
   }
 
-  it = ngtcp2_acktr_get(acktr);
-  if (ngtcp2_ksl_it_end(&it)) {
+  if (ngtcp2_acktr_empty(acktr)) {
     ngtcp2_acktr_commit_ack(acktr);
     return 0;
   }
 
-  if (conn->tx.ack == NULL) {
-    conn->tx.ack = ngtcp2_mem_malloc(
+  if (pktns->tx.ack.fr == NULL) {
+    pktns->tx.ack.fr = ngtcp2_mem_malloc(
         conn->mem,
         sizeof(ngtcp2_ack) + sizeof(ngtcp2_ack_blk) * initial_max_ack_blks);
-    if (conn->tx.ack == NULL) {
+    if (pktns->tx.ack.fr == NULL) {
       return NGTCP2_ERR_NOMEM;
     }
-    conn->tx.max_ack_blks = initial_max_ack_blks;
+    pktns->tx.ack.max_blks = initial_max_ack_blks;
   }
 
-  ack = &conn->tx.ack->ack;
+  ack = &pktns->tx.ack.fr->ack;
+  rpkt = ngtcp2_acktr_get(acktr, 0);
+
+  /* If only the range of the largest packet number has grown upward
+     since the last time, the other ACK blocks are still valid. */
+  if (pktns->tx.ack.acktr_gen == acktr->gen &&
+      rpkt->pkt_num == pktns->rx.max_pkt_num &&
+      rpkt->pkt_num - (int64_t)(rpkt->len - 1) ==
+          ack->largest_ack - (int64_t)ack->first_ack_blklen) {
+    pktns->tx.ack.largest_ack_ts = rpkt->tstamp;
+    ack->largest_ack = rpkt->pkt_num;
+    ack->first_ack_blklen = rpkt->len - 1;
+  } else {
+    rv = pktns_build_ack_blks(pktns, conn->mem);
+    if (rv != 0) {
+      return rv;
+    }
+
+    ack = &pktns->tx.ack.fr->ack;
+  }
 
   if (pktns->rx.ecn.ect0 || pktns->rx.ecn.ect1 || pktns->rx.ecn.ce) {
     ack->type = NGTCP2_FRAME_ACK_ECN;
@@ -1717,28 +2141,9 @@ static int conn_create_ack_frame(ngtcp2_conn *conn, ngtcp2_frame **pfr,
   } else {
     ack->type = NGTCP2_FRAME_ACK;
   }
-  ack->num_blks = 0;
-
-  rpkt = ngtcp2_ksl_it_get(&it);
-
-  if (rpkt->pkt_num == pktns->rx.max_pkt_num) {
-    last_pkt_num = rpkt->pkt_num - (int64_t)(rpkt->len - 1);
-    largest_ack_ts = rpkt->tstamp;
-    ack->largest_ack = rpkt->pkt_num;
-    ack->first_ack_blklen = rpkt->len - 1;
-
-    ngtcp2_ksl_it_next(&it);
-  } else {
-    assert(rpkt->pkt_num < pktns->rx.max_pkt_num);
-
-    last_pkt_num = pktns->rx.max_pkt_num;
-    largest_ack_ts = pktns->rx.max_pkt_ts;
-    ack->largest_ack = pktns->rx.max_pkt_num;
-    ack->first_ack_blklen = 0;
-  }
 
   if (type == NGTCP2_PKT_1RTT) {
-    ack->ack_delay_unscaled = ts - largest_ack_ts;
+    ack->ack_delay_unscaled = ts - pktns->tx.ack.largest_ack_ts;
     ack->ack_delay = ack->ack_delay_unscaled / NGTCP2_MICROSECONDS /
                      (1ULL << ack_delay_exponent);
   } else {
@@ -1746,33 +2151,7 @@ static int conn_create_ack_frame(ngtcp2_conn *conn, ngtcp2_frame **pfr,
     ack->ack_delay = 0;
   }
 
-  for (; !ngtcp2_ksl_it_end(&it); ngtcp2_ksl_it_next(&it)) {
-    if (ack->num_blks == NGTCP2_MAX_ACK_BLKS) {
-      break;
-    }
-
-    rpkt = ngtcp2_ksl_it_get(&it);
-
-    blk_idx = ack->num_blks++;
-    rv = conn_ensure_ack_blks(conn, ack->num_blks);
-    if (rv != 0) {
-      return rv;
-    }
-    ack = &conn->tx.ack->ack;
-    blk = &ack->blks[blk_idx];
-    blk->gap = (uint64_t)(last_pkt_num - rpkt->pkt_num - 2);
-    blk->blklen = rpkt->len - 1;
-
-    last_pkt_num = rpkt->pkt_num - (int64_t)(rpkt->len - 1);
-  }
-
-  /* TODO Just remove entries which cannot fit into a single ACK frame
-     for now. */
-  if (!ngtcp2_ksl_it_end(&it)) {
-    ngtcp2_acktr_forget(acktr, ngtcp2_ksl_it_get(&it));
-  }
-
-  *pfr = conn->tx.ack;
+  *pfr = pktns->tx.ack.fr;
 
   return 0;
 }
@@ -1923,7 +2302,7 @@ static uint64_t conn_retry_early_payloadlen(ngtcp2_conn *conn) {
     return 0;
   }
 
-  for (; !ngtcp2_pq_empty(&conn->tx.strmq);) {
+  for (; !ngtcp2_conn_tx_strmq_empty(conn);) {
     strm = ngtcp2_conn_tx_strmq_top(conn);
     if (ngtcp2_strm_streamfrq_empty(strm)) {
       ngtcp2_conn_tx_strmq_pop(conn);
@@ -1944,15 +2323,7 @@ static uint64_t conn_retry_early_payloadlen(ngtcp2_conn *conn) {
 }
 
 static void conn_cryptofrq_clear(ngtcp2_conn *conn, ngtcp2_pktns *pktns) {
-  ngtcp2_frame_chain *frc;
-  ngtcp2_ksl_it it;
-
-  for (it = ngtcp2_ksl_begin(&pktns->crypto.tx.frq); !ngtcp2_ksl_it_end(&it);
-       ngtcp2_ksl_it_next(&it)) {
-    frc = ngtcp2_ksl_it_get(&it);
-    ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
-  }
-  ngtcp2_ksl_clear(&pktns->crypto.tx.frq);
+  ngtcp2_cryptofrq_clear(&pktns->crypto.tx.frq, conn->frc_objalloc, conn->mem);
 }
 
 /*
@@ -1966,14 +2337,11 @@ static uint64_t conn_cryptofrq_unacked_offset(ngtcp2_conn *conn,
   ngtcp2_crypto *fr;
   ngtcp2_range gap;
   ngtcp2_rtb *rtb = &pktns->rtb;
-  ngtcp2_ksl_it it;
   uint64_t datalen;
 
   (void)conn;
 
-  for (it = ngtcp2_ksl_begin(&pktns->crypto.tx.frq); !ngtcp2_ksl_it_end(&it);
-       ngtcp2_ksl_it_next(&it)) {
-    frc = ngtcp2_ksl_it_get(&it);
+  for (frc = pktns->crypto.tx.frq.head; frc; frc = frc->next) {
     fr = &frc->fr.crypto;
 
     gap = ngtcp2_strm_get_unacked_range_after(rtb->crypto, fr->offset);
@@ -2002,16 +2370,13 @@ static int conn_cryptofrq_unacked_pop(ngtcp2_conn *conn, ngtcp2_pktns *pktns,
   ngtcp2_rtb *rtb = &pktns->rtb;
   ngtcp2_vec *v;
   int rv;
-  ngtcp2_ksl_it it;
 
   *pfrc = NULL;
 
-  for (it = ngtcp2_ksl_begin(&pktns->crypto.tx.frq); !ngtcp2_ksl_it_end(&it);) {
-    frc = ngtcp2_ksl_it_get(&it);
+  for (; pktns->crypto.tx.frq.len;) {
+    frc = ngtcp2_cryptofrq_pop(&pktns->crypto.tx.frq);
     fr = &frc->fr.crypto;
 
-    ngtcp2_ksl_remove_hint(&pktns->crypto.tx.frq, &it, &it, &fr->offset);
-
     idx = 0;
     offset = fr->offset;
     base_offset = 0;
@@ -2032,7 +2397,7 @@ static int conn_cryptofrq_unacked_pop(ngtcp2_conn *conn, ngtcp2_pktns *pktns,
     }
 
     if (idx == fr->datacnt) {
-      ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
+      ngtcp2_frame_chain_objalloc_del(frc, conn->frc_objalloc, conn->mem);
       continue;
     }
 
@@ -2072,9 +2437,9 @@ static int conn_cryptofrq_unacked_pop(ngtcp2_conn *conn, ngtcp2_pktns *pktns,
     }
 
     rv = ngtcp2_frame_chain_crypto_datacnt_objalloc_new(
-        &nfrc, fr->datacnt - end_idx, &conn->frc_objalloc, conn->mem);
+        &nfrc, fr->datacnt - end_idx, conn->frc_objalloc, conn->mem);
     if (rv != 0) {
-      ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
+      ngtcp2_frame_chain_objalloc_del(frc, conn->frc_objalloc, conn->mem);
       return rv;
     }
 
@@ -2090,13 +2455,7 @@ static int conn_cryptofrq_unacked_pop(ngtcp2_conn *conn, ngtcp2_pktns *pktns,
     nfr->data[0].base += end_base_offset;
     nfr->data[0].len -= (size_t)end_base_offset;
 
-    rv = ngtcp2_ksl_insert(&pktns->crypto.tx.frq, NULL, &nfr->offset, nfrc);
-    if (rv != 0) {
-      assert(ngtcp2_err_is_fatal(rv));
-      ngtcp2_frame_chain_objalloc_del(nfrc, &conn->frc_objalloc, conn->mem);
-      ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
-      return rv;
-    }
+    ngtcp2_cryptofrq_push(&pktns->crypto.tx.frq, nfrc);
 
     if (end_base_offset) {
       ++end_idx;
@@ -2129,9 +2488,7 @@ static int conn_cryptofrq_pop(ngtcp2_conn *conn, ngtcp2_frame_chain **pfrc,
   size_t nmerged;
   uint64_t datalen;
   ngtcp2_vec a[NGTCP2_MAX_CRYPTO_DATACNT];
-  ngtcp2_vec b[NGTCP2_MAX_CRYPTO_DATACNT];
-  size_t acnt, bcnt;
-  ngtcp2_ksl_it it;
+  size_t acnt, idx, offset;
 
   rv = conn_cryptofrq_unacked_pop(conn, pktns, &frc);
   if (rv != 0) {
@@ -2146,65 +2503,48 @@ static int conn_cryptofrq_pop(ngtcp2_conn *conn, ngtcp2_frame_chain **pfrc,
   datalen = ngtcp2_vec_len(fr->data, fr->datacnt);
 
   if (datalen > left) {
-    ngtcp2_vec_copy(a, fr->data, fr->datacnt);
-    acnt = fr->datacnt;
-
-    bcnt = 0;
-    ngtcp2_vec_split(a, &acnt, b, &bcnt, left, NGTCP2_MAX_CRYPTO_DATACNT);
-
-    assert(acnt > 0);
-    assert(bcnt > 0);
+    /* The remaining data is copied to a new frame directly from
+       fr->data, and frc is truncated in place to carry the first
+       |left| bytes. */
+    idx = ngtcp2_vec_split_at(fr->data, fr->datacnt, left, &offset);
 
     rv = ngtcp2_frame_chain_crypto_datacnt_objalloc_new(
-        &nfrc, bcnt, &conn->frc_objalloc, conn->mem);
+        &nfrc, fr->datacnt - idx, conn->frc_objalloc, conn->mem);
     if (rv != 0) {
       assert(ngtcp2_err_is_fatal(rv));
-      ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
+      ngtcp2_frame_chain_objalloc_del(frc, conn->frc_objalloc, conn->mem);
       return rv;
     }
 
     nfr = &nfrc->fr.crypto;
     nfr->type = NGTCP2_FRAME_CRYPTO;
     nfr->offset = fr->offset + left;
-    nfr->datacnt = bcnt;
-    ngtcp2_vec_copy(nfr->data, b, bcnt);
+    nfr->datacnt = fr->datacnt - idx;
+    ngtcp2_vec_copy(nfr->data, fr->data + idx, nfr->datacnt);
+    nfr->data[0].base += offset;
+    nfr->data[0].len -= offset;
 
-    rv = ngtcp2_ksl_insert(&pktns->crypto.tx.frq, NULL, &nfr->offset, nfrc);
-    if (rv != 0) {
-      assert(ngtcp2_err_is_fatal(rv));
-      ngtcp2_frame_chain_objalloc_del(nfrc, &conn->frc_objalloc, conn->mem);
-      ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
-      return rv;
-    }
+    ngtcp2_cryptofrq_push(&pktns->crypto.tx.frq, nfrc);
 
-    rv = ngtcp2_frame_chain_crypto_datacnt_objalloc_new(
-        &nfrc, acnt, &conn->frc_objalloc, conn->mem);
-    if (rv != 0) {
-      assert(ngtcp2_err_is_fatal(rv));
-      ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
-      return rv;
+    fr->datacnt = idx;
+    if (offset) {
+      fr->data[fr->datacnt++].len = offset;
     }
 
-    nfr = &nfrc->fr.crypto;
-    *nfr = *fr;
-    nfr->datacnt = acnt;
-    ngtcp2_vec_copy(nfr->data, a, acnt);
-
-    ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
+    assert(fr->datacnt > 0);
 
-    *pfrc = nfrc;
+    *pfrc = frc;
 
     return 0;
   }
 
   left -= (size_t)datalen;
 
-  ngtcp2_vec_copy(a, fr->data, fr->datacnt);
-  acnt = fr->datacnt;
+  /* a is filled lazily when the first frame is merged. */
+  acnt = 0;
 
-  for (; left && ngtcp2_ksl_len(&pktns->crypto.tx.frq);) {
-    it = ngtcp2_ksl_begin(&pktns->crypto.tx.frq);
-    nfrc = ngtcp2_ksl_it_get(&it);
+  for (; left && pktns->crypto.tx.frq.len;) {
+    nfrc = pktns->crypto.tx.frq.head;
     nfr = &nfrc->fr.crypto;
 
     if (nfr->offset != fr->offset + datalen) {
@@ -2215,7 +2555,7 @@ static int conn_cryptofrq_pop(ngtcp2_conn *conn, ngtcp2_frame_chain **pfrc,
     rv = conn_cryptofrq_unacked_pop(conn, pktns, &nfrc);
     if (rv != 0) {
       assert(ngtcp2_err_is_fatal(rv));
-      ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
+      ngtcp2_frame_chain_objalloc_del(frc, conn->frc_objalloc, conn->mem);
       return rv;
     }
     if (nfrc == NULL) {
@@ -2224,16 +2564,15 @@ static int conn_cryptofrq_pop(ngtcp2_conn *conn, ngtcp2_frame_chain **pfrc,
 
     nfr = &nfrc->fr.crypto;
 
+    if (acnt == 0) {
+      ngtcp2_vec_copy(a, fr->data, fr->datacnt);
+      acnt = fr->datacnt;
+    }
+
     nmerged = ngtcp2_vec_merge(a, &acnt, nfr->data, &nfr->datacnt, left,
                                NGTCP2_MAX_CRYPTO_DATACNT);
     if (nmerged == 0) {
-      rv = ngtcp2_ksl_insert(&pktns->crypto.tx.frq, NULL, &nfr->offset, nfrc);
-      if (rv != 0) {
-        assert(ngtcp2_err_is_fatal(rv));
-        ngtcp2_frame_chain_objalloc_del(nfrc, &conn->frc_objalloc, conn->mem);
-        ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
-        return rv;
-      }
+      ngtcp2_cryptofrq_push(&pktns->crypto.tx.frq, nfrc);
       break;
     }
 
@@ -2241,24 +2580,23 @@ static int conn_cryptofrq_pop(ngtcp2_conn *conn, ngtcp2_frame_chain **pfrc,
     left -= nmerged;
 
     if (nfr->datacnt == 0) {
-      ngtcp2_frame_chain_objalloc_del(nfrc, &conn->frc_objalloc, conn->mem);
+      ngtcp2_frame_chain_objalloc_del(nfrc, conn->frc_objalloc, conn->mem);
       continue;
     }
 
     nfr->offset += nmerged;
 
-    rv = ngtcp2_ksl_insert(&pktns->crypto.tx.frq, NULL, &nfr->offset, nfrc);
-    if (rv != 0) {
-      ngtcp2_frame_chain_objalloc_del(nfrc, &conn->frc_objalloc, conn->mem);
-      ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
-      return rv;
-    }
+    ngtcp2_cryptofrq_push(&pktns->crypto.tx.frq, nfrc);
 
     break;
   }
 
+  if (acnt == 0) {
+    *pfrc = frc;
+    return 0;
+  }
+
   if (acnt == fr->datacnt) {
-    assert(acnt > 0);
     fr->data[acnt - 1] = a[acnt - 1];
 
     *pfrc = frc;
@@ -2268,9 +2606,9 @@ static int conn_cryptofrq_pop(ngtcp2_conn *conn, ngtcp2_frame_chain **pfrc,
   assert(acnt > fr->datacnt);
 
   rv = ngtcp2_frame_chain_crypto_datacnt_objalloc_new(
-      &nfrc, acnt, &conn->frc_objalloc, conn->mem);
+      &nfrc, acnt, conn->frc_objalloc, conn->mem);
   if (rv != 0) {
-    ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
+    ngtcp2_frame_chain_objalloc_del(frc, conn->frc_objalloc, conn->mem);
     return rv;
   }
 
@@ -2279,7 +2617,7 @@ static int conn_cryptofrq_pop(ngtcp2_conn *conn, ngtcp2_frame_chain **pfrc,
   nfr->datacnt = acnt;
   ngtcp2_vec_copy(nfr->data, a, acnt);
 
-  ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
+  ngtcp2_frame_chain_objalloc_del(frc, conn->frc_objalloc, conn->mem);
 
   *pfrc = nfrc;
 
@@ -2313,7 +2651,7 @@ static int conn_verify_dcid(ngtcp2_conn *conn, int *pnew_cid_used,
   }
 
   scid = ngtcp2_ksl_it_get(&it);
-  if (!ngtcp2_cid_eq(&scid->cid, &hd->dcid)) {
+  if (!ngtcp2_cid_eq_inline(&scid->cid, &hd->dcid)) {
     return NGTCP2_ERR_INVALID_ARGUMENT;
   }
 
@@ -2337,6 +2675,36 @@ static int conn_verify_dcid(ngtcp2_conn *conn, int *pnew_cid_used,
   return 0;
 }
 
+/*
+ * conn_coalesced_pkt_overhead returns the number of bytes, excluding
+ * payload, that a packet of type |type| which is coalesced after the
+ * current one occupies.  It includes packet header and AEAD
+ * overhead.
+ */
+static size_t conn_coalesced_pkt_overhead(ngtcp2_conn *conn, uint8_t type) {
+  size_t len;
+
+  switch (type) {
+  case NGTCP2_PKT_HANDSHAKE:
+    len = NGTCP2_MIN_LONG_HEADERLEN - 2 + conn->dcid.current.cid.datalen +
+          conn->oscid.datalen + NGTCP2_PKT_LENGTHLEN +
+          pktns_select_pkt_numlen(conn->hs_pktns);
+    break;
+  case NGTCP2_PKT_0RTT:
+    len = NGTCP2_MIN_LONG_HEADERLEN - 2 + conn->dcid.current.cid.datalen +
+          conn->oscid.datalen + NGTCP2_PKT_LENGTHLEN +
+          pktns_select_pkt_numlen(&conn->pktns);
+    break;
+  default:
+    assert(type == NGTCP2_PKT_1RTT);
+
+    len = 1 + conn->dcid.current.cid.datalen +
+          pktns_select_pkt_numlen(&conn->pktns);
+  }
+
+  return len + NGTCP2_MAX_AEAD_OVERHEAD;
+}
+
 /*
  * conn_should_pad_pkt returns nonzero if the packet should be padded.
  * |type| is the type of packet.  |left| is the space left in packet
@@ -2347,31 +2715,34 @@ static int conn_should_pad_pkt(ngtcp2_conn *conn, uint8_t type, size_t left,
                                uint64_t write_datalen, int ack_eliciting,
                                int require_padding) {
   uint64_t min_payloadlen;
+  uint8_t next_type;
 
   if (type == NGTCP2_PKT_INITIAL) {
-    if (conn->server) {
+    if (conn_is_server(conn)) {
       if (!ack_eliciting) {
         return 0;
       }
 
       if (conn->hs_pktns->crypto.tx.ckm &&
           (conn->hs_pktns->rtb.probe_pkt_left ||
-           ngtcp2_ksl_len(&conn->hs_pktns->crypto.tx.frq) ||
+           conn->hs_pktns->crypto.tx.frq.len ||
            !ngtcp2_acktr_empty(&conn->hs_pktns->acktr))) {
         /* If we have something to send in Handshake packet, then add
            PADDING in Handshake packet. */
         min_payloadlen = NGTCP2_MIN_COALESCED_PAYLOADLEN;
+        next_type = NGTCP2_PKT_HANDSHAKE;
       } else {
         return 1;
       }
     } else {
       if (conn->hs_pktns->crypto.tx.ckm &&
           (conn->hs_pktns->rtb.probe_pkt_left ||
-           ngtcp2_ksl_len(&conn->hs_pktns->crypto.tx.frq) ||
+           conn->hs_pktns->crypto.tx.frq.len ||
            !ngtcp2_acktr_empty(&conn->hs_pktns->acktr))) {
         /* If we have something to send in Handshake packet, then add
            PADDING in Handshake packet. */
         min_payloadlen = NGTCP2_MIN_COALESCED_PAYLOADLEN;
+        next_type = NGTCP2_PKT_HANDSHAKE;
       } else if ((!conn->early.ckm && !conn->pktns.crypto.tx.ckm) ||
                  write_datalen == 0) {
         return 1;
@@ -2381,6 +2752,8 @@ static int conn_should_pad_pkt(ngtcp2_conn *conn, uint8_t type, size_t left,
            write_datalen includes DATAGRAM which cannot be split. */
         min_payloadlen =
             ngtcp2_max(write_datalen, NGTCP2_MIN_COALESCED_PAYLOADLEN);
+        next_type =
+            conn->pktns.crypto.tx.ckm ? NGTCP2_PKT_1RTT : NGTCP2_PKT_0RTT;
       }
     }
   } else {
@@ -2395,14 +2768,14 @@ static int conn_should_pad_pkt(ngtcp2_conn *conn, uint8_t type, size_t left,
     }
 
     min_payloadlen = ngtcp2_max(write_datalen, NGTCP2_MIN_COALESCED_PAYLOADLEN);
+    next_type = NGTCP2_PKT_1RTT;
   }
 
-  /* TODO the next packet type should be taken into account */
+  /* A short header 1RTT packet is smaller than a long header packet.
+     Sizing the next packet exactly avoids padding this packet and
+     pushing the next one into a separate datagram when both fit. */
   return left <
-         /* TODO Assuming that pkt_num is encoded in 1 byte. */
-         NGTCP2_MIN_LONG_HEADERLEN + conn->dcid.current.cid.datalen +
-             conn->oscid.datalen + NGTCP2_PKT_LENGTHLEN - 1 + min_payloadlen +
-             NGTCP2_MAX_AEAD_OVERHEAD;
+         conn_coalesced_pkt_overhead(conn, next_type) + min_payloadlen;
 }
 
 static void conn_restart_timer_on_write(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
@@ -2415,6 +2788,15 @@ static void conn_restart_timer_on_read(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
   conn->flags |= NGTCP2_CONN_FLAG_RESTART_IDLE_TIMER_ON_WRITE;
 }
 
+/*
+ * conn_invalidate_expiry discards the earliest expiry cached by
+ * ngtcp2_conn_get_expiry.  The public functions which might change
+ * any timer must call it.
+ */
+static void conn_invalidate_expiry(ngtcp2_conn *conn) {
+  conn->flags &= (uint32_t)~NGTCP2_CONN_FLAG_EXPIRY_VALID;
+}
+
 /*
  * conn_keep_alive_enabled returns nonzero if keep-alive is enabled.
  */
@@ -2435,7 +2817,8 @@ static int conn_keep_alive_expired(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
  * conn_keep_alive_expiry returns the expiry time of keep-alive timer.
  */
 static ngtcp2_tstamp conn_keep_alive_expiry(ngtcp2_conn *conn) {
-  if ((conn->flags & NGTCP2_CONN_FLAG_KEEP_ALIVE_CANCELLED) ||
+  if ((conn->flags & (NGTCP2_CONN_FLAG_KEEP_ALIVE_CANCELLED |
+                      NGTCP2_CONN_FLAG_KEEP_ALIVE_EXTERNAL)) ||
       !conn_keep_alive_enabled(conn)) {
     return UINT64_MAX;
   }
@@ -2467,9 +2850,29 @@ static void conn_update_keep_alive_last_ts(ngtcp2_conn *conn,
 
 void ngtcp2_conn_set_keep_alive_timeout(ngtcp2_conn *conn,
                                         ngtcp2_duration timeout) {
+  conn_invalidate_expiry(conn);
+
   conn->keep_alive.timeout = timeout;
 }
 
+void ngtcp2_conn_set_keep_alive_external(ngtcp2_conn *conn, int external) {
+  conn_invalidate_expiry(conn);
+
+  if (external) {
+    conn->flags |= NGTCP2_CONN_FLAG_KEEP_ALIVE_EXTERNAL;
+  } else {
+    conn->flags &= (uint32_t)~NGTCP2_CONN_FLAG_KEEP_ALIVE_EXTERNAL;
+  }
+}
+
+ngtcp2_tstamp ngtcp2_conn_get_keep_alive_expiry(ngtcp2_conn *conn) {
+  if (!conn_keep_alive_enabled(conn)) {
+    return UINT64_MAX;
+  }
+
+  return conn->keep_alive.last_ts + conn->keep_alive.timeout;
+}
+
 /*
  * NGTCP2_PKT_PACING_OVERHEAD defines overhead of userspace event
  * loop.  Packet pacing might require sub milliseconds packet spacing,
@@ -2481,13 +2884,22 @@ void ngtcp2_conn_set_keep_alive_timeout(ngtcp2_conn *conn,
  */
 #define NGTCP2_PKT_PACING_OVERHEAD NGTCP2_MILLISECONDS
 
+/*
+ * conn_pacing_lookahead returns the duration that a packet can be
+ * written ahead of its scheduled transmission time.
+ */
+static ngtcp2_duration conn_pacing_lookahead(ngtcp2_conn *conn) {
+  return ngtcp2_max(NGTCP2_PKT_PACING_OVERHEAD,
+                    conn->local.settings.pacing_horizon);
+}
+
 static void conn_cancel_expired_pkt_tx_timer(ngtcp2_conn *conn,
                                              ngtcp2_tstamp ts) {
   if (conn->tx.pacing.next_ts == UINT64_MAX) {
     return;
   }
 
-  if (conn->tx.pacing.next_ts > ts + NGTCP2_PKT_PACING_OVERHEAD) {
+  if (conn->tx.pacing.next_ts > ts + conn_pacing_lookahead(conn)) {
     return;
   }
 
@@ -2496,7 +2908,23 @@ static void conn_cancel_expired_pkt_tx_timer(ngtcp2_conn *conn,
 
 static int conn_pacing_pkt_tx_allowed(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
   return conn->tx.pacing.next_ts == UINT64_MAX ||
-         conn->tx.pacing.next_ts <= ts + NGTCP2_PKT_PACING_OVERHEAD;
+         conn->tx.pacing.next_ts <= ts + conn_pacing_lookahead(conn);
+}
+
+/*
+ * conn_pkt_tx_time returns the intended departure time of the packet
+ * which is about to be written at |ts|.  The packets written since
+ * the last call of ngtcp2_conn_update_pkt_tx_time are spread out at
+ * the pacing rate.
+ */
+static ngtcp2_tstamp conn_pkt_tx_time(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
+  if (!(conn->cstat.pacing_rate > 0)) {
+    return ts;
+  }
+
+  return ngtcp2_max(ts, conn->tx.pacing.departure_ts) +
+         (ngtcp2_duration)((double)conn->tx.pacing.pktlen /
+                           conn->cstat.pacing_rate);
 }
 
 static uint8_t conn_pkt_flags(ngtcp2_conn *conn) {
@@ -2514,10 +2942,40 @@ static uint8_t conn_pkt_flags_long(ngtcp2_conn *conn) {
 }
 
 static uint8_t conn_pkt_flags_short(ngtcp2_conn *conn) {
-  return (uint8_t)(conn_pkt_flags(conn) | ((conn->pktns.crypto.tx.ckm->flags &
-                                            NGTCP2_CRYPTO_KM_FLAG_KEY_PHASE_ONE)
-                                               ? NGTCP2_PKT_FLAG_KEY_PHASE
-                                               : NGTCP2_PKT_FLAG_NONE));
+  uint8_t flags = conn_pkt_flags(conn);
+
+  if (conn->pktns.crypto.tx.ckm->flags & NGTCP2_CRYPTO_KM_FLAG_KEY_PHASE_ONE) {
+    flags |= NGTCP2_PKT_FLAG_KEY_PHASE;
+  }
+
+  if ((conn->flags & NGTCP2_CONN_FLAG_SPIN_BIT) &&
+      conn->spin.dcid_seq != conn->dcid.current.seq) {
+    /* RFC 9000 section 17.4 resets the spin value when a new
+       Connection ID is used. */
+    conn->spin.value = 0;
+    conn->spin.dcid_seq = conn->dcid.current.seq;
+  }
+
+  if (conn->spin.value) {
+    flags |= NGTCP2_PKT_FLAG_SPIN_BIT;
+  }
+
+  return flags;
+}
+
+/*
+ * conn_update_spin_bit updates the spin value to send from the 1RTT
+ * packet |hd| which has the largest packet number received so far.
+ * Server echoes the received value, and client inverts it.
+ */
+static void conn_update_spin_bit(ngtcp2_conn *conn, const ngtcp2_pkt_hd *hd) {
+  uint8_t spin = (hd->flags & NGTCP2_PKT_FLAG_SPIN_BIT) != 0;
+
+  if (!(conn->flags & NGTCP2_CONN_FLAG_SPIN_BIT)) {
+    return;
+  }
+
+  conn->spin.value = conn_is_server(conn) ? spin : !spin;
 }
 
 /*
@@ -2560,6 +3018,7 @@ conn_write_handshake_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi, uint8_t *dest,
   uint64_t crypto_offset;
   ngtcp2_ssize num_reclaimed;
   uint32_t version;
+  ngtcp2_perf_phase perf_phase;
 
   switch (type) {
   case NGTCP2_PKT_INITIAL:
@@ -2598,13 +3057,15 @@ conn_write_handshake_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi, uint8_t *dest,
   cc.hp = pktns->crypto.ctx.hp;
   cc.encrypt = conn->callbacks.encrypt;
   cc.hp_mask = conn->callbacks.hp_mask;
+  cc.encrypt_hp_mask = conn->callbacks.encrypt_hp_mask;
+  cc.encrypt_vec = conn->callbacks.encrypt_vec;
 
   ngtcp2_pkt_hd_init(&hd, conn_pkt_flags_long(conn), type,
                      &conn->dcid.current.cid, &conn->oscid,
                      pktns->tx.last_pkt_num + 1, pktns_select_pkt_numlen(pktns),
                      version, 0);
 
-  if (!conn->server && type == NGTCP2_PKT_INITIAL &&
+  if (!conn_is_server(conn) && type == NGTCP2_PKT_INITIAL &&
       conn->local.settings.token.len) {
     hd.token = conn->local.settings.token;
   }
@@ -2625,7 +3086,7 @@ conn_write_handshake_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi, uint8_t *dest,
                              /* ack_delay = */ 0,
                              NGTCP2_DEFAULT_ACK_DELAY_EXPONENT);
   if (rv != 0) {
-    ngtcp2_frame_chain_list_objalloc_del(frq, &conn->frc_objalloc, conn->mem);
+    ngtcp2_frame_chain_list_objalloc_del(frq, conn->frc_objalloc, conn->mem);
     return rv;
   }
 
@@ -2634,6 +3095,7 @@ conn_write_handshake_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi, uint8_t *dest,
     if (rv != 0) {
       assert(NGTCP2_ERR_NOBUF == rv);
     } else {
+      conn_record_ack_delay(conn, &pktns->acktr, ts);
       ngtcp2_acktr_commit_ack(&pktns->acktr);
       ngtcp2_acktr_add_ack(&pktns->acktr, hd.pkt_num, ackfr->ack.largest_ack);
       pkt_empty = 0;
@@ -2642,10 +3104,10 @@ conn_write_handshake_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi, uint8_t *dest,
 
   /* Server requires at least NGTCP2_MAX_UDP_PAYLOAD_SIZE bytes in
      order to send ack-eliciting Initial packet. */
-  if (!conn->server || type != NGTCP2_PKT_INITIAL ||
+  if (!conn_is_server(conn) || type != NGTCP2_PKT_INITIAL ||
       destlen >= NGTCP2_MAX_UDP_PAYLOAD_SIZE) {
   build_pkt:
-    for (; ngtcp2_ksl_len(&pktns->crypto.tx.frq);) {
+    for (; pktns->crypto.tx.frq.len;) {
       left = ngtcp2_ppe_left(&ppe);
 
       crypto_offset = conn_cryptofrq_unacked_offset(conn, pktns);
@@ -2662,7 +3124,7 @@ conn_write_handshake_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi, uint8_t *dest,
       rv = conn_cryptofrq_pop(conn, &nfrc, pktns, left);
       if (rv != 0) {
         assert(ngtcp2_err_is_fatal(rv));
-        ngtcp2_frame_chain_list_objalloc_del(frq, &conn->frc_objalloc,
+        ngtcp2_frame_chain_list_objalloc_del(frq, conn->frc_objalloc,
                                              conn->mem);
         return rv;
       }
@@ -2687,9 +3149,10 @@ conn_write_handshake_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi, uint8_t *dest,
 
     if (!(rtb_entry_flags & NGTCP2_RTB_ENTRY_FLAG_ACK_ELICITING) &&
         pktns->rtb.num_retransmittable && pktns->rtb.probe_pkt_left) {
-      num_reclaimed = ngtcp2_rtb_reclaim_on_pto(&pktns->rtb, conn, pktns, 1);
+      num_reclaimed =
+          ngtcp2_rtb_reclaim_on_pto(&pktns->rtb, conn, pktns, 1, 0);
       if (num_reclaimed < 0) {
-        ngtcp2_frame_chain_list_objalloc_del(frq, &conn->frc_objalloc,
+        ngtcp2_frame_chain_list_objalloc_del(frq, conn->frc_objalloc,
                                              conn->mem);
         return rv;
       }
@@ -2703,7 +3166,7 @@ conn_write_handshake_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi, uint8_t *dest,
          until it knows that server has completed address validation or
          handshake has been confirmed. */
       if (pktns->rtb.num_pto_eliciting == 0 &&
-          (conn->server ||
+          (conn_is_server(conn) ||
            (conn->flags & (NGTCP2_CONN_FLAG_SERVER_ADDR_VERIFIED |
                            NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED)))) {
         pktns->rtb.probe_pkt_left = 0;
@@ -2773,14 +3236,17 @@ conn_write_handshake_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi, uint8_t *dest,
     ngtcp2_qlog_write_frame(&conn->qlog, &lfr);
   }
 
+  perf_phase = ngtcp2_perf_switch(&conn->perf, NGTCP2_PERF_PHASE_ENCRYPT);
   spktlen = ngtcp2_ppe_final(&ppe, NULL);
+  ngtcp2_perf_switch(&conn->perf, perf_phase);
   if (spktlen < 0) {
     assert(ngtcp2_err_is_fatal((int)spktlen));
-    ngtcp2_frame_chain_list_objalloc_del(frq, &conn->frc_objalloc, conn->mem);
+    ngtcp2_frame_chain_list_objalloc_del(frq, conn->frc_objalloc, conn->mem);
     return spktlen;
   }
 
   ngtcp2_qlog_pkt_sent_end(&conn->qlog, &hd, (size_t)spktlen);
+  NGTCP2_PROBE4(pkt_sent, conn, hd.pkt_num, hd.type, spktlen);
 
   if ((rtb_entry_flags & NGTCP2_RTB_ENTRY_FLAG_ACK_ELICITING) || padded) {
     if (pi) {
@@ -2789,17 +3255,17 @@ conn_write_handshake_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi, uint8_t *dest,
 
     rv = ngtcp2_rtb_entry_objalloc_new(&rtbent, &hd, frq, ts, (size_t)spktlen,
                                        rtb_entry_flags,
-                                       &conn->rtb_entry_objalloc);
+                                       conn->rtb_entry_objalloc);
     if (rv != 0) {
       assert(ngtcp2_err_is_fatal(rv));
-      ngtcp2_frame_chain_list_objalloc_del(frq, &conn->frc_objalloc, conn->mem);
+      ngtcp2_frame_chain_list_objalloc_del(frq, conn->frc_objalloc, conn->mem);
       return rv;
     }
 
     rv = conn_on_pkt_sent(conn, &pktns->rtb, rtbent);
     if (rv != 0) {
-      ngtcp2_rtb_entry_objalloc_del(rtbent, &conn->rtb_entry_objalloc,
-                                    &conn->frc_objalloc, conn->mem);
+      ngtcp2_rtb_entry_objalloc_del(rtbent, conn->rtb_entry_objalloc,
+                                    conn->frc_objalloc, conn->mem);
       return rv;
     }
 
@@ -2949,9 +3415,31 @@ static void conn_discard_initial_state(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
   memset(&conn->vneg.tx, 0, sizeof(conn->vneg.tx));
 }
 
+/*
+ * conn_free_handshake_only_state frees the state which is only used
+ * during the handshake.  The address validation token is only sent
+ * or verified in Initial packets, the preferred versions are only
+ * used to negotiate the version, and Retry packet is only accepted
+ * before the handshake progresses.
+ */
+static void conn_free_handshake_only_state(ngtcp2_conn *conn) {
+  ngtcp2_mem_free(conn->mem, conn->local.settings.token.base);
+  conn->local.settings.token.base = NULL;
+  conn->local.settings.token.len = 0;
+
+  ngtcp2_mem_free(conn->mem, conn->vneg.preferred_versions);
+  conn->vneg.preferred_versions = NULL;
+  conn->vneg.preferred_versionslen = 0;
+
+  conn_call_delete_crypto_aead_ctx(conn, &conn->crypto.retry_aead_ctx);
+  memset(&conn->crypto.retry_aead_ctx, 0,
+         sizeof(conn->crypto.retry_aead_ctx));
+}
+
 /*
  * conn_discard_handshake_state discards state for Handshake packet
- * number space.
+ * number space.  It is called when the handshake is confirmed, so
+ * that the other handshake-only state is freed as well.
  */
 static void conn_discard_handshake_state(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
   if (!conn->hs_pktns) {
@@ -2962,6 +3450,8 @@ static void conn_discard_handshake_state(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
                   "discarding Handshake packet number space");
 
   conn_discard_pktns(conn, &conn->hs_pktns, ts);
+
+  conn_free_handshake_only_state(conn);
 }
 
 /*
@@ -2997,7 +3487,7 @@ static ngtcp2_ssize conn_write_handshake_ack_pkts(ngtcp2_conn *conn,
      because once it gets server Initial, it gets Handshake tx key and
      discards Initial key.  The only good reason to send ACK is give
      server RTT measurement early. */
-  if (conn->server && conn->in_pktns) {
+  if (conn_is_server(conn) && conn->in_pktns) {
     nwrite =
         conn_write_ack_pkt(conn, pi, dest, destlen, NGTCP2_PKT_INITIAL, ts);
     if (nwrite < 0) {
@@ -3020,7 +3510,7 @@ static ngtcp2_ssize conn_write_handshake_ack_pkts(ngtcp2_conn *conn,
 
     res += nwrite;
 
-    if (!conn->server && nwrite) {
+    if (!conn_is_server(conn) && nwrite) {
       conn_discard_initial_state(conn, ts);
     }
   }
@@ -3090,6 +3580,87 @@ static uint64_t conn_server_tx_left(ngtcp2_conn *conn, ngtcp2_dcid *dcid) {
   return dcid_tx_left(dcid);
 }
 
+/*
+ * conn_handshake_data_pending returns nonzero if Initial or Handshake
+ * CRYPTO data or probe packets are waiting to be sent.
+ */
+static int conn_handshake_data_pending(ngtcp2_conn *conn) {
+  ngtcp2_pktns *in_pktns = conn->in_pktns;
+  ngtcp2_pktns *hs_pktns = conn->hs_pktns;
+
+  return (in_pktns && (in_pktns->rtb.probe_pkt_left ||
+                       in_pktns->crypto.tx.frq.len)) ||
+         (hs_pktns && (hs_pktns->rtb.probe_pkt_left ||
+                       hs_pktns->crypto.tx.frq.len));
+}
+
+/*
+ * conn_amplification_blocked records that server cannot send the
+ * pending Initial or Handshake packets because of the amplification
+ * limit.
+ */
+static void conn_amplification_blocked(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
+  if (conn->tx.ampl_blocked_ts != UINT64_MAX ||
+      !conn_handshake_data_pending(conn)) {
+    return;
+  }
+
+  ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_CON,
+                  "handshake blocked by amplification limit");
+
+  conn->tx.ampl_blocked_ts = ts;
+  ++conn->cstat.amplification_limited_count;
+}
+
+/*
+ * conn_amplification_unblocked adds the time that server has waited
+ * for the amplification limit budget to
+ * ngtcp2_conn_stat.amplification_limited_duration.  This function
+ * must be called when the budget increases.
+ */
+static void conn_amplification_unblocked(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
+  if (conn->tx.ampl_blocked_ts == UINT64_MAX) {
+    return;
+  }
+
+  if (ts > conn->tx.ampl_blocked_ts) {
+    conn->cstat.amplification_limited_duration +=
+        ts - conn->tx.ampl_blocked_ts;
+  }
+
+  conn->tx.ampl_blocked_ts = UINT64_MAX;
+}
+
+/*
+ * conn_server_tx_left_1rtt returns the maximum number of bytes that
+ * server is allowed to send in 1RTT packets to an unvalidated path
+ * if ngtcp2_settings.handshake_first is set.  |tx_left| is the return
+ * value of conn_server_tx_left.
+ */
+static uint64_t conn_server_tx_left_1rtt(ngtcp2_conn *conn, uint64_t tx_left) {
+  uint64_t reserved = 0;
+
+  if (conn_handshake_data_pending(conn)) {
+    return 0;
+  }
+
+  /* Keep the budget to retransmit Initial and Handshake packets in
+     flight if they are lost. */
+  if (conn->in_pktns) {
+    reserved += conn->in_pktns->rtb.cc_bytes_in_flight;
+  }
+
+  if (conn->hs_pktns) {
+    reserved += conn->hs_pktns->rtb.cc_bytes_in_flight;
+  }
+
+  if (tx_left <= reserved) {
+    return 0;
+  }
+
+  return tx_left - reserved;
+}
+
 /*
  * conn_write_handshake_pkts writes Initial and Handshake packets in
  * the buffer pointed by |dest| whose length is |destlen|.
@@ -3112,7 +3683,7 @@ static ngtcp2_ssize conn_write_handshake_pkts(ngtcp2_conn *conn,
   ngtcp2_rtb_entry *rtbent;
   uint8_t wflags = NGTCP2_WRITE_PKT_FLAG_NONE;
   ngtcp2_conn_stat *cstat = &conn->cstat;
-  ngtcp2_ksl_it it;
+  ngtcp2_rtb_it it;
 
   /* As a client, we would like to discard Initial packet number space
      when sending the first Handshake packet.  When sending Handshake
@@ -3126,7 +3697,8 @@ static ngtcp2_ssize conn_write_handshake_pkts(ngtcp2_conn *conn,
      pending Initial ACK, Initial packet number space is discarded
      after writing the first Handshake packet.
    */
-  if (!conn->server && conn->hs_pktns->crypto.tx.ckm && conn->in_pktns &&
+  if (!conn_is_server(conn) && conn->hs_pktns->crypto.tx.ckm &&
+      conn->in_pktns &&
       !ngtcp2_acktr_require_active_ack(&conn->in_pktns->acktr,
                                        /* max_ack_delay = */ 0, ts) &&
       (ngtcp2_acktr_require_active_ack(&conn->hs_pktns->acktr,
@@ -3145,15 +3717,19 @@ static ngtcp2_ssize conn_write_handshake_pkts(ngtcp2_conn *conn,
     }
 
     if (nwrite == 0) {
-      if (conn->server && (conn->in_pktns->rtb.probe_pkt_left ||
-                           ngtcp2_ksl_len(&conn->in_pktns->crypto.tx.frq))) {
-        if (cstat->loss_detection_timer != UINT64_MAX &&
+      if (conn_is_server(conn) && (conn->in_pktns->rtb.probe_pkt_left ||
+                                   conn->in_pktns->crypto.tx.frq.len)) {
+        if (!(conn->dcid.current.flags & NGTCP2_DCID_FLAG_PATH_VALIDATED) &&
             conn_server_tx_left(conn, &conn->dcid.current) <
                 NGTCP2_MAX_UDP_PAYLOAD_SIZE) {
-          ngtcp2_log_info(
-              &conn->log, NGTCP2_LOG_EVENT_RCV,
-              "loss detection timer canceled due to amplification limit");
-          cstat->loss_detection_timer = UINT64_MAX;
+          conn_amplification_blocked(conn, ts);
+
+          if (cstat->loss_detection_timer != UINT64_MAX) {
+            ngtcp2_log_info(
+                &conn->log, NGTCP2_LOG_EVENT_RCV,
+                "loss detection timer canceled due to amplification limit");
+            cstat->loss_detection_timer = UINT64_MAX;
+          }
         }
 
         return 0;
@@ -3167,10 +3743,10 @@ static ngtcp2_ssize conn_write_handshake_pkts(ngtcp2_conn *conn,
         /* We might have already added padding to Initial, but in that
            case, we should have destlen == 0 and no Handshake packet
            will be written. */
-        if (conn->server) {
+        if (conn_is_server(conn)) {
           it = ngtcp2_rtb_head(&conn->in_pktns->rtb);
-          if (!ngtcp2_ksl_it_end(&it)) {
-            rtbent = ngtcp2_ksl_it_get(&it);
+          if (!ngtcp2_rtb_it_end(&it)) {
+            rtbent = ngtcp2_rtb_it_get(&it);
             if (rtbent->flags & NGTCP2_RTB_ENTRY_FLAG_ACK_ELICITING) {
               wflags |= NGTCP2_WRITE_PKT_FLAG_REQUIRE_PADDING;
             }
@@ -3191,7 +3767,7 @@ static ngtcp2_ssize conn_write_handshake_pkts(ngtcp2_conn *conn,
 
   res += nwrite;
 
-  if (!conn->server && conn->hs_pktns->crypto.tx.ckm && nwrite) {
+  if (!conn_is_server(conn) && conn->hs_pktns->crypto.tx.ckm && nwrite) {
     /* We don't need to send further Initial packet if we have
        Handshake key and sent something with it.  So discard initial
        state here. */
@@ -3222,6 +3798,15 @@ static uint64_t conn_initial_stream_rx_offset(ngtcp2_conn *conn,
   return conn->local.transport_params.initial_max_stream_data_uni;
 }
 
+/*
+ * conn_mem_budget_exceeded returns nonzero if the memory allocated by
+ * |conn| reaches ngtcp2_settings.mem_budget.
+ */
+static int conn_mem_budget_exceeded(ngtcp2_conn *conn) {
+  return conn->local.settings.mem_budget &&
+         conn->mem_acct.total >= conn->local.settings.mem_budget;
+}
+
 /*
  * conn_should_send_max_stream_data returns nonzero if MAX_STREAM_DATA
  * frame should be send for |strm|.
@@ -3234,14 +3819,129 @@ static int conn_should_send_max_stream_data(ngtcp2_conn *conn,
   return strm->rx.window < 2 * inc;
 }
 
+/*
+ * conn_flow_window_target returns the flow control window that
+ * |window| should be grown to, or |window| if it should not be grown.
+ * |consumed| is the amount of window which the application consumed
+ * in |elapsed| since the last window update.  The window is scaled
+ * up if it is updated more often than NGTCP2_FLOW_WINDOW_RTT_FACTOR
+ * times |smoothed_rtt|.  It grows by at least
+ * NGTCP2_FLOW_WINDOW_SCALING_FACTOR, or to
+ * NGTCP2_FLOW_WINDOW_BDP_FACTOR times the bandwidth-delay product
+ * estimated from the receiving rate and |smoothed_rtt| if that is
+ * larger, so that a high BDP path reaches its window in a few round
+ * trips.  The returned value never exceeds |max_window|.
+ */
+static uint64_t conn_flow_window_target(uint64_t window, uint64_t max_window,
+                                        uint64_t consumed,
+                                        ngtcp2_duration elapsed,
+                                        ngtcp2_duration smoothed_rtt) {
+  uint64_t target;
+  double bdp;
+
+  if (window >= max_window ||
+      elapsed >= NGTCP2_FLOW_WINDOW_RTT_FACTOR * smoothed_rtt) {
+    return window;
+  }
+
+  target = NGTCP2_FLOW_WINDOW_SCALING_FACTOR * window;
+
+  if (elapsed == 0) {
+    return max_window;
+  }
+
+  bdp = (double)consumed * (double)smoothed_rtt / (double)elapsed;
+  if (bdp * NGTCP2_FLOW_WINDOW_BDP_FACTOR >= (double)max_window) {
+    return max_window;
+  }
+
+  target = ngtcp2_max(target, (uint64_t)(bdp * NGTCP2_FLOW_WINDOW_BDP_FACTOR));
+
+  return ngtcp2_min(target, max_window);
+}
+
 /*
  * conn_should_send_max_data returns nonzero if MAX_DATA frame should
- * be sent.
+ * be sent.  It returns 0 while the memory budget is exceeded so that
+ * the remote endpoint cannot make |conn| buffer more data.
  */
 static int conn_should_send_max_data(ngtcp2_conn *conn) {
   uint64_t inc = conn->rx.unsent_max_offset - conn->rx.max_offset;
 
-  return conn->rx.window < 2 * inc;
+  return conn->rx.window < 2 * inc && !conn_mem_budget_exceeded(conn);
+}
+
+/*
+ * conn_flow_credit_low returns nonzero if the remote endpoint which
+ * has sent data up to |offset| is left with less than a quarter of
+ * |window| before it is blocked at |max_offset|.
+ */
+static int conn_flow_credit_low(uint64_t max_offset, uint64_t offset,
+                                uint64_t window) {
+  return max_offset - ngtcp2_min(max_offset, offset) < window / 4;
+}
+
+/*
+ * conn_update_flow_update_urgency marks the pending flow control
+ * updates urgent if |strm| is waiting for MAX_STREAM_DATA and the
+ * remote endpoint is about to be blocked by it.
+ */
+static void conn_update_flow_update_urgency(ngtcp2_conn *conn,
+                                            ngtcp2_strm *strm) {
+  if (conn->local.settings.coalesce_flow_control_update &&
+      ngtcp2_strm_is_tx_queued(strm) &&
+      conn_should_send_max_stream_data(conn, strm) &&
+      conn_flow_credit_low(strm->rx.max_offset, strm->rx.last_offset,
+                           strm->rx.window)) {
+    conn->tx.flow_update.urgent = 1;
+  }
+}
+
+/*
+ * conn_defer_flow_update returns nonzero if MAX_DATA and
+ * MAX_STREAM_DATA frames should not be written to a packet in |pktns|
+ * at |ts| so that they are coalesced with the later updates.
+ * |send_data| is nonzero if the packet carries application data.  The
+ * updates are deferred by at most a quarter of smoothed RTT, and they
+ * are sent without delay if they can ride on a packet which is sent
+ * anyway, or if the remote endpoint is about to be blocked.
+ */
+static int conn_defer_flow_update(ngtcp2_conn *conn, ngtcp2_pktns *pktns,
+                                  int send_data, ngtcp2_tstamp ts) {
+  ngtcp2_acktr *acktr = &pktns->acktr;
+  ngtcp2_duration ack_delay;
+  int send_max_data;
+
+  if (!conn->local.settings.coalesce_flow_control_update || send_data ||
+      conn->tx.flow_update.urgent || pktns->tx.frq ||
+      conn->tx.strmq_nretrans || pktns->rtb.probe_pkt_left) {
+    return 0;
+  }
+
+  send_max_data = conn_should_send_max_data(conn);
+  if (send_max_data && conn_flow_credit_low(conn->rx.max_offset,
+                                            conn->rx.offset, conn->rx.window)) {
+    return 0;
+  }
+
+  if (!send_max_data && ngtcp2_conn_tx_strmq_empty(conn)) {
+    return 0;
+  }
+
+  ack_delay = (acktr->flags & NGTCP2_ACKTR_FLAG_IMMEDIATE_ACK)
+                  ? 0
+                  : conn_compute_ack_delay(conn);
+
+  if (!ngtcp2_acktr_empty(acktr) &&
+      ngtcp2_acktr_require_active_ack(acktr, ack_delay, ts)) {
+    return 0;
+  }
+
+  if (conn->tx.flow_update.first_ts == UINT64_MAX) {
+    conn->tx.flow_update.first_ts = ts;
+  }
+
+  return ts < conn->tx.flow_update.first_ts + conn->cstat.smoothed_rtt / 4;
 }
 
 /*
@@ -3284,20 +3984,41 @@ static size_t conn_required_num_new_connection_id(ngtcp2_conn *conn) {
 static int conn_enqueue_new_connection_id(ngtcp2_conn *conn) {
   size_t i, need = conn_required_num_new_connection_id(conn);
   size_t cidlen = conn->oscid.datalen;
+  ngtcp2_cid cids[NGTCP2_MAX_SCID_POOL_SIZE];
+  uint8_t tokens[NGTCP2_MAX_SCID_POOL_SIZE * NGTCP2_STATELESS_RESET_TOKENLEN];
   ngtcp2_cid cid;
   uint64_t seq;
   int rv;
-  uint8_t token[NGTCP2_STATELESS_RESET_TOKENLEN];
+  uint8_t *token;
   ngtcp2_frame_chain *nfrc;
   ngtcp2_pktns *pktns = &conn->pktns;
   ngtcp2_scid *scid;
   ngtcp2_ksl_it it;
 
-  for (i = 0; i < need; ++i) {
-    rv = conn_call_get_new_connection_id(conn, &cid, token, cidlen);
+  if (need == 0) {
+    return 0;
+  }
+
+  assert(need <= NGTCP2_MAX_SCID_POOL_SIZE);
+
+  if (conn->callbacks.get_new_connection_ids) {
+    rv = conn_call_get_new_connection_ids(conn, cids, tokens, cidlen, need);
     if (rv != 0) {
       return rv;
     }
+  }
+
+  for (i = 0; i < need; ++i) {
+    token = tokens + i * NGTCP2_STATELESS_RESET_TOKENLEN;
+
+    if (conn->callbacks.get_new_connection_ids) {
+      cid = cids[i];
+    } else {
+      rv = conn_call_get_new_connection_id(conn, &cid, token, cidlen);
+      if (rv != 0) {
+        return rv;
+      }
+    }
 
     if (cid.datalen != cidlen) {
       return NGTCP2_ERR_CALLBACK_FAILURE;
@@ -3306,7 +4027,7 @@ static int conn_enqueue_new_connection_id(ngtcp2_conn *conn) {
     /* Assert uniqueness */
     it = ngtcp2_ksl_lower_bound(&conn->scid.set, &cid);
     if (!ngtcp2_ksl_it_end(&it) &&
-        ngtcp2_cid_eq(ngtcp2_ksl_it_key(&it), &cid)) {
+        ngtcp2_cid_eq_inline(ngtcp2_ksl_it_key(&it), &cid)) {
       return NGTCP2_ERR_CALLBACK_FAILURE;
     }
 
@@ -3325,7 +4046,7 @@ static int conn_enqueue_new_connection_id(ngtcp2_conn *conn) {
       return rv;
     }
 
-    rv = ngtcp2_frame_chain_objalloc_new(&nfrc, &conn->frc_objalloc);
+    rv = ngtcp2_frame_chain_objalloc_new(&nfrc, conn->frc_objalloc);
     if (rv != 0) {
       return rv;
     }
@@ -3335,7 +4056,7 @@ static int conn_enqueue_new_connection_id(ngtcp2_conn *conn) {
     nfrc->fr.new_connection_id.retire_prior_to = 0;
     nfrc->fr.new_connection_id.cid = cid;
     memcpy(nfrc->fr.new_connection_id.stateless_reset_token, token,
-           sizeof(token));
+           NGTCP2_STATELESS_RESET_TOKENLEN);
     nfrc->next = pktns->tx.frq;
     pktns->tx.frq = nfrc;
   }
@@ -3436,35 +4157,466 @@ static void conn_handle_unconfirmed_key_update_from_remote(ngtcp2_conn *conn,
 }
 
 /*
- * conn_write_pkt writes a protected packet in the buffer pointed by
- * |dest| whose length if |destlen|.  |type| specifies the type of
- * packet.  It can be NGTCP2_PKT_1RTT or NGTCP2_PKT_0RTT.
+ * conn_protect_pkts protects all pending 1RTT packets whose
+ * protection is deferred.
  *
- * This function can send new stream data.  In order to send stream
- * data, specify the underlying stream and parameters to
- * |vmsg|->stream.  If |vmsg|->stream.fin is set to nonzero, it
- * signals that the given data is the final portion of the stream.
- * |vmsg|->stream.data vector of length |vmsg|->stream.datacnt
- * specifies stream data to send.  The number of bytes sent to the
- * stream is assigned to *|vmsg|->stream.pdatalen.  If 0 length STREAM
- * data is sent, 0 is assigned to it.  The caller should initialize
- * *|vmsg|->stream.pdatalen to -1.
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
  *
- * If |require_padding| is nonzero, padding bytes are added to occupy
- * the remaining packet payload.
+ * NGTCP2_ERR_INVALID_STATE
+ *     A job detached by ngtcp2_conn_detach_protect_job is
+ *     outstanding, and it might use the same crypto context on
+ *     another thread.
+ * NGTCP2_ERR_CALLBACK_FAILURE
+ *     User-defined callback function failed.
+ */
+static int conn_protect_pkts(ngtcp2_conn *conn) {
+  ngtcp2_conn_protect *protect = conn->protect;
+  int rv;
+  ngtcp2_perf_phase perf_phase;
+
+  if (!protect || protect->len == 0) {
+    return 0;
+  }
+
+  if (conn->protect_jobs) {
+    return NGTCP2_ERR_INVALID_STATE;
+  }
+
+  perf_phase = ngtcp2_perf_switch(&conn->perf, NGTCP2_PERF_PHASE_ENCRYPT);
+  rv = ngtcp2_ppe_protect_deferred(
+      &protect->cc, conn->callbacks.encrypt_batch,
+      conn->callbacks.hp_mask_batch, &protect->batch, protect->pkts,
+      protect->len);
+  ngtcp2_perf_switch(&conn->perf, perf_phase);
+
+  protect->len = 0;
+
+  return rv;
+}
+
+/*
+ * conn_ppe_final_deferred finalizes 1RTT packet in |ppe| without
+ * protecting it.  The packet is protected later by
+ * conn_protect_pkts.  If the pending packets are protected with the
+ * different key, or there is no room to add another packet, the
+ * pending packets are protected first.  If conn->protect cannot be
+ * allocated, the packet is protected immediately.
  *
- * This function returns the number of bytes written in |dest| if it
- * succeeds, or one of the following negative error codes:
+ * This function returns the length of QUIC packet if it succeeds, or
+ * one of the following negative error codes:
  *
- * NGTCP2_ERR_NOMEM
- *     Out of memory.
  * NGTCP2_ERR_CALLBACK_FAILURE
  *     User-defined callback function failed.
- * NGTCP2_ERR_STREAM_DATA_BLOCKED
- *     Stream data could not be written because of flow control.
  */
-static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
-                                   uint8_t *dest, size_t destlen,
+static ngtcp2_ssize conn_ppe_final_deferred(ngtcp2_conn *conn,
+                                            ngtcp2_ppe *ppe) {
+  ngtcp2_conn_protect *protect = conn->protect;
+  int rv;
+
+  if (!protect) {
+    protect = ngtcp2_mem_malloc(conn->mem, sizeof(*protect));
+    if (!protect) {
+      return ngtcp2_ppe_final(ppe, NULL);
+    }
+
+    protect->len = 0;
+    conn->protect = protect;
+  }
+
+  if (protect->len && (protect->cc.ckm != ppe->cc->ckm ||
+                       protect->len == NGTCP2_MAX_DEFERRED_PKTS)) {
+    rv = conn_protect_pkts(conn);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  if (protect->len == 0) {
+    protect->cc = *ppe->cc;
+  }
+
+  return ngtcp2_ppe_final_deferred(ppe, &protect->pkts[protect->len++]);
+}
+
+/*
+ * conn_ppe_final_offload finalizes 1RTT packet in |ppe| without
+ * protecting it, and describes it in |pi|, so that NIC or kernel
+ * protects it on transmit.
+ *
+ * This function returns the length of QUIC packet.
+ */
+static ngtcp2_ssize conn_ppe_final_offload(ngtcp2_conn *conn,
+                                           ngtcp2_pkt_info *pi,
+                                           ngtcp2_ppe *ppe) {
+  ngtcp2_ppe_deferred dpkt;
+  ngtcp2_ssize nwrite = ngtcp2_ppe_final_deferred(ppe, &dpkt);
+
+  pi->offload_key_id = conn->crypto.key_update.tx_key_id;
+  pi->offload_pkt_num = dpkt.pkt_num;
+  pi->offload_pktlen = (uint16_t)nwrite;
+  pi->offload_hdlen = (uint16_t)dpkt.hdlen;
+  pi->offload_pkt_numlen = (uint8_t)dpkt.pkt_numlen;
+
+  return nwrite;
+}
+
+/*
+ * conn_protect_jobs_blocked returns nonzero if the next 1RTT packet
+ * cannot be deferred without protecting the pending packets on the
+ * connection thread while a job detached by
+ * ngtcp2_conn_detach_protect_job is outstanding.
+ */
+static int conn_protect_jobs_blocked(ngtcp2_conn *conn) {
+  ngtcp2_conn_protect *protect = conn->protect;
+
+  return conn->protect_jobs && protect && protect->len &&
+         (protect->len == NGTCP2_MAX_DEFERRED_PKTS ||
+          protect->cc.ckm != conn->pktns.crypto.tx.ckm);
+}
+
+/*
+ * conn_protect_jobs_refer returns nonzero if any outstanding job
+ * refers to |ckm|.
+ */
+static int conn_protect_jobs_refer(ngtcp2_conn *conn,
+                                   const ngtcp2_crypto_km *ckm) {
+  ngtcp2_protect_job *job;
+
+  for (job = conn->protect_jobs; job; job = job->next) {
+    if (job->cc.ckm == ckm) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * conn_fec_max_symbollen returns the maximum length of stream data
+ * that a STREAM frame protected by REPAIR frame carries.  It returns
+ * 0 if the forward error correction extension is not negotiated.
+ */
+static size_t conn_fec_max_symbollen(ngtcp2_conn *conn) {
+  if (!conn->local.transport_params.fec_window ||
+      !conn->remote.transport_params) {
+    return 0;
+  }
+
+  /* Keep the group within the half of the remote window so that the
+     remote endpoint still retains the other source symbols when a
+     REPAIR frame arrives. */
+  return (size_t)ngtcp2_min(NGTCP2_MAX_FEC_SYMBOLLEN,
+                            conn->remote.transport_params->fec_window / 2);
+}
+
+/*
+ * conn_fec_flush queues REPAIR frame of the current group of |strm|
+ * to conn->tx.repairq.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ */
+static int conn_fec_flush(ngtcp2_conn *conn, ngtcp2_strm *strm) {
+  ngtcp2_fec_enc *enc = strm->tx.fec;
+  size_t avail = sizeof(ngtcp2_frame) - sizeof(ngtcp2_repair);
+  ngtcp2_frame_chain *frc, **pfrc;
+  int rv;
+
+  rv = ngtcp2_frame_chain_extralen_objalloc_new(
+      &frc, enc->repairlen > avail ? enc->repairlen - avail : 0,
+      conn->frc_objalloc, conn->mem);
+  if (rv != 0) {
+    return rv;
+  }
+
+  ngtcp2_fec_enc_write_repair(enc, &frc->fr.repair, strm->stream_id,
+                              (uint8_t *)&frc->fr + sizeof(ngtcp2_repair));
+
+  for (pfrc = &conn->tx.repairq; *pfrc; pfrc = &(*pfrc)->next)
+    ;
+
+  *pfrc = frc;
+
+  return 0;
+}
+
+/*
+ * conn_fec_add_stream_frame adds the data of STREAM frame |fr| sent
+ * to |strm| to the current group.  REPAIR frame is queued if the
+ * group is complete, or |flush| is nonzero.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ */
+static int conn_fec_add_stream_frame(ngtcp2_conn *conn, ngtcp2_strm *strm,
+                                     const ngtcp2_stream *fr, int flush) {
+  ngtcp2_fec_enc *enc = strm->tx.fec;
+  uint64_t datalen = ngtcp2_vec_len(fr->data, fr->datacnt);
+  int rv;
+
+  if (enc->symbolcnt && ngtcp2_fec_enc_span(enc) + datalen >
+                            conn->remote.transport_params->fec_window / 2) {
+    rv = conn_fec_flush(conn, strm);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  ngtcp2_fec_enc_add(enc, fr->offset, fr->data, fr->datacnt);
+
+  if (flush || ngtcp2_fec_enc_full(enc)) {
+    return conn_fec_flush(conn, strm);
+  }
+
+  return 0;
+}
+
+/*
+ * conn_repair_obsolete returns nonzero if REPAIR frame |fr| is no
+ * longer useful because all data it protects have been acknowledged,
+ * or the stream has gone.
+ */
+static int conn_repair_obsolete(ngtcp2_conn *conn, const ngtcp2_repair *fr) {
+  ngtcp2_strm *strm = ngtcp2_conn_find_stream(conn, fr->stream_id);
+  ngtcp2_range r;
+  uint64_t end = fr->offset;
+  size_t i;
+
+  if (strm == NULL || (strm->flags & NGTCP2_STRM_FLAG_SENT_RST)) {
+    return 1;
+  }
+
+  for (i = 0; i < fr->symbolcnt; ++i) {
+    end += fr->symbollen[i];
+  }
+
+  r = ngtcp2_strm_get_unacked_range_after(strm, fr->offset);
+
+  return r.begin >= end;
+}
+
+/*
+ * conn_dgramq_pop removes the first DATAGRAM from conn->tx.dgramq and
+ * returns it.
+ */
+static ngtcp2_dgram_entry *conn_dgramq_pop(ngtcp2_conn *conn) {
+  ngtcp2_dgram_entry *ent = conn->tx.dgramq;
+
+  conn->tx.dgramq = ent->next;
+  if (conn->tx.dgramq == NULL) {
+    conn->tx.dgramq_tail = NULL;
+  }
+  --conn->tx.dgramq_len;
+
+  return ent;
+}
+
+/*
+ * conn_write_dgramq writes DATAGRAM frames queued in conn->tx.dgramq
+ * to |ppe| as many as they fit.  The queued DATAGRAMs which have
+ * expired by |ts|, or which never fit in a packet, are dropped, and
+ * ngtcp2_lost_datagram callback is called for them.  If a DATAGRAM
+ * frame is written, |*ppkt_empty| is set to 0, and
+ * |*prtb_entry_flags| is updated.  If ngtcp2_ack_datagram or
+ * ngtcp2_lost_datagram callback is set, the written frames are
+ * appended to |*ppfrc| so that dgram_id is passed to them later.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory
+ * NGTCP2_ERR_CALLBACK_FAILURE
+ *     User callback failed
+ */
+static int conn_write_dgramq(ngtcp2_conn *conn, ngtcp2_ppe *ppe,
+                             int *phd_logged, const ngtcp2_pkt_hd *hd,
+                             ngtcp2_frame_chain ***ppfrc, int *ppkt_empty,
+                             uint16_t *prtb_entry_flags, ngtcp2_tstamp ts) {
+  ngtcp2_dgram_entry *ent;
+  ngtcp2_frame_chain *nfrc;
+  ngtcp2_frame lfr, *fr;
+  size_t framelen, left;
+  int track = conn->callbacks.ack_datagram || conn->callbacks.lost_datagram;
+  int rv;
+
+  for (; conn->tx.dgramq;) {
+    ent = conn->tx.dgramq;
+    framelen = ngtcp2_pkt_datagram_framelen(ent->datalen);
+    left = ngtcp2_ppe_left(ppe);
+
+    if (ent->expiry <= ts ||
+        left + ngtcp2_buf_len(&ppe->buf) - ppe->hdlen < framelen) {
+      conn_dgramq_pop(conn);
+
+      ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_PKT,
+                      "drop queued DATAGRAM dgram_id=%" PRIu64 " len=%zu",
+                      ent->dgram_id, ent->datalen);
+
+      if (conn->callbacks.lost_datagram) {
+        rv = conn->callbacks.lost_datagram(conn, ent->dgram_id,
+                                           conn->user_data);
+        if (rv != 0) {
+          ngtcp2_mem_free(conn->mem, ent);
+          return NGTCP2_ERR_CALLBACK_FAILURE;
+        }
+      }
+
+      ngtcp2_mem_free(conn->mem, ent);
+
+      continue;
+    }
+
+    if (left < framelen) {
+      return 0;
+    }
+
+    if (track) {
+      rv = ngtcp2_frame_chain_objalloc_new(&nfrc, conn->frc_objalloc);
+      if (rv != 0) {
+        return rv;
+      }
+
+      fr = &nfrc->fr;
+    } else {
+      fr = &lfr;
+    }
+
+    fr->datagram.type = NGTCP2_FRAME_DATAGRAM_LEN;
+    fr->datagram.dgram_id = ent->dgram_id;
+    fr->datagram.datacnt = ent->datacnt;
+    fr->datagram.data = ent->data;
+
+    rv = conn_ppe_write_frame_hd_log(conn, ppe, phd_logged, hd, fr);
+    assert(rv == 0);
+
+    conn_dgramq_pop(conn);
+    ngtcp2_mem_free(conn->mem, ent);
+
+    if (track) {
+      /* The data is not used anymore.  See conn_write_pkt. */
+      nfrc->fr.datagram.datacnt = 0;
+      nfrc->fr.datagram.data = NULL;
+
+      **ppfrc = nfrc;
+      *ppfrc = &nfrc->next;
+    }
+
+    *ppkt_empty = 0;
+    *prtb_entry_flags |=
+        NGTCP2_RTB_ENTRY_FLAG_ACK_ELICITING | NGTCP2_RTB_ENTRY_FLAG_DATAGRAM;
+  }
+
+  return 0;
+}
+
+/*
+ * conn_should_send_max_remote_streams returns nonzero if MAX_STREAMS
+ * should be sent to raise the limit of the remote streams from
+ * |max_streams| to |unsent_max_streams|.  If
+ * ngtcp2_settings.auto_max_streams is enabled, the extension is held
+ * back until it reaches the half of |window| unless |blocked| is
+ * nonzero.
+ */
+static int conn_should_send_max_remote_streams(ngtcp2_conn *conn,
+                                               uint64_t unsent_max_streams,
+                                               uint64_t max_streams,
+                                               uint64_t window, int blocked) {
+  if (unsent_max_streams <= max_streams) {
+    return 0;
+  }
+
+  if (!conn->local.settings.auto_max_streams || blocked) {
+    return 1;
+  }
+
+  return unsent_max_streams - max_streams >= ngtcp2_max(window / 2, 1);
+}
+
+static int conn_should_send_max_streams_bidi(ngtcp2_conn *conn) {
+  return conn_should_send_max_remote_streams(
+      conn, conn->remote.bidi.unsent_max_streams, conn->remote.bidi.max_streams,
+      conn->remote.bidi.window, conn->remote.bidi.blocked);
+}
+
+static int conn_should_send_max_streams_uni(ngtcp2_conn *conn) {
+  return conn_should_send_max_remote_streams(
+      conn, conn->remote.uni.unsent_max_streams, conn->remote.uni.max_streams,
+      conn->remote.uni.window, conn->remote.uni.blocked);
+}
+
+/*
+ * conn_stream_only_pkt returns nonzero if a 1RTT packet carries
+ * nothing but new stream data, that is, none of PATH_RESPONSE, ACK,
+ * the pending frames in pktns->tx.frq, CRYPTO, MAX_STREAMS, REPAIR,
+ * queued DATAGRAM, retransmitted STREAM, and probe frames has to be
+ * sent.  This is the steady state of a bulk transfer, and
+ * conn_write_pkt skips straight to writing STREAM frame after the
+ * packet header.  MAX_DATA and NEW_CONNECTION_ID are queued to
+ * pktns->tx.frq before this function is called.
+ */
+static int conn_stream_only_pkt(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
+  ngtcp2_pktns *pktns = &conn->pktns;
+  ngtcp2_acktr *acktr = &pktns->acktr;
+  ngtcp2_duration ack_delay;
+
+  if (pktns->tx.frq || pktns->rtb.probe_pkt_left ||
+      !ngtcp2_conn_tx_strmq_empty(conn) || pktns->crypto.tx.frq.len ||
+      ngtcp2_ringbuf_len(&conn->rx.path_challenge.rb) || conn->tx.repairq ||
+      conn->tx.dgramq || conn_should_send_max_streams_bidi(conn) ||
+      conn_should_send_max_streams_uni(conn)) {
+    return 0;
+  }
+
+  if (acktr->first_unacked_ts != UINT64_MAX) {
+    ack_delay = (acktr->flags & NGTCP2_ACKTR_FLAG_IMMEDIATE_ACK)
+                    ? 0
+                    : conn_compute_ack_delay(conn);
+    if (ngtcp2_acktr_require_active_ack(acktr, ack_delay, ts)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/*
+ * conn_write_pkt writes a protected packet in the buffer pointed by
+ * |dest| whose length if |destlen|.  |type| specifies the type of
+ * packet.  It can be NGTCP2_PKT_1RTT or NGTCP2_PKT_0RTT.
+ *
+ * This function can send new stream data.  In order to send stream
+ * data, specify the underlying stream and parameters to
+ * |vmsg|->stream.  If |vmsg|->stream.fin is set to nonzero, it
+ * signals that the given data is the final portion of the stream.
+ * |vmsg|->stream.data vector of length |vmsg|->stream.datacnt
+ * specifies stream data to send.  The number of bytes sent to the
+ * stream is assigned to *|vmsg|->stream.pdatalen.  If 0 length STREAM
+ * data is sent, 0 is assigned to it.  The caller should initialize
+ * *|vmsg|->stream.pdatalen to -1.
+ *
+ * If |require_padding| is nonzero, padding bytes are added to occupy
+ * the remaining packet payload.
+ *
+ * This function returns the number of bytes written in |dest| if it
+ * succeeds, or one of the following negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ * NGTCP2_ERR_CALLBACK_FAILURE
+ *     User-defined callback function failed.
+ * NGTCP2_ERR_STREAM_DATA_BLOCKED
+ *     Stream data could not be written because of flow control.
+ */
+static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
+                                   uint8_t *dest, size_t destlen,
                                    ngtcp2_vmsg *vmsg, uint8_t type,
                                    uint8_t flags, ngtcp2_tstamp ts) {
   int rv = 0;
@@ -3492,6 +4644,7 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
   uint8_t hd_flags = NGTCP2_PKT_FLAG_NONE;
   int require_padding = (flags & NGTCP2_WRITE_PKT_FLAG_REQUIRE_PADDING) != 0;
   int write_more = (flags & NGTCP2_WRITE_PKT_FLAG_MORE) != 0;
+  int pmtud_probe = (flags & NGTCP2_WRITE_PKT_FLAG_PMTUD_PROBE) != 0;
   int ppe_pending = (conn->flags & NGTCP2_CONN_FLAG_PPE_PENDING) != 0;
   size_t min_pktlen = conn_min_short_pktlen(conn);
   int padded = 0;
@@ -3506,6 +4659,12 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
   const ngtcp2_cid *scid = NULL;
   int keep_alive_expired = 0;
   uint32_t version = 0;
+  ngtcp2_perf_phase perf_phase;
+  size_t stream_left;
+  size_t fec_max_symbollen;
+  int pto_reclaimed = 0;
+  int defer_flow_update = 0;
+  int dgramq_deferred = 0;
 
   /* Return 0 if destlen is less than minimum packet length which can
      trigger Stateless Reset */
@@ -3517,12 +4676,20 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
     switch (vmsg->type) {
     case NGTCP2_VMSG_TYPE_STREAM:
       datalen = ngtcp2_vec_len(vmsg->stream.data, vmsg->stream.datacnt);
+      if (conn->latency && datalen &&
+          vmsg->stream.strm->tx.offer_ts == UINT64_MAX) {
+        vmsg->stream.strm->tx.offer_ts = ts;
+      }
       ndatalen = conn_enforce_flow_control(conn, vmsg->stream.strm, datalen);
       /* 0 length STREAM frame is allowed */
       if (ndatalen || datalen == 0) {
         send_stream = 1;
       } else {
         stream_blocked = 1;
+        NGTCP2_PROBE6(flow_blocked, conn, vmsg->stream.strm->stream_id,
+                      vmsg->stream.strm->tx.offset,
+                      vmsg->stream.strm->tx.max_offset, conn->tx.offset,
+                      conn->tx.max_offset);
       }
       break;
     case NGTCP2_VMSG_TYPE_DATAGRAM:
@@ -3579,23 +4746,50 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
 
     cc->encrypt = conn->callbacks.encrypt;
     cc->hp_mask = conn->callbacks.hp_mask;
+    cc->encrypt_hp_mask = conn->callbacks.encrypt_hp_mask;
+    cc->encrypt_vec = conn->callbacks.encrypt_vec;
+
+    /* Unless new data comes first, reclaim an in-flight packet before
+       writing any frame, so that its frames lead the probe packet.
+       Nothing is reclaimed while the frames reclaimed earlier are
+       still waiting to be sent. */
+    if (type == NGTCP2_PKT_1RTT && pktns->rtb.probe_pkt_left &&
+        conn->local.settings.pto_probe_policy !=
+            NGTCP2_PTO_PROBE_POLICY_NEW_DATA_FIRST &&
+        pktns->rtb.num_retransmittable && pktns->tx.frq == NULL &&
+        conn->tx.strmq_nretrans == 0) {
+      num_reclaimed = ngtcp2_rtb_reclaim_on_pto(
+          &pktns->rtb, conn, pktns, 1,
+          conn->local.settings.pto_probe_policy ==
+              NGTCP2_PTO_PROBE_POLICY_DUPLICATE_LATEST);
+      if (num_reclaimed < 0) {
+        return num_reclaimed;
+      }
+
+      pto_reclaimed = num_reclaimed != 0;
+    }
+
+    defer_flow_update =
+        type == NGTCP2_PKT_1RTT &&
+        conn_defer_flow_update(conn, pktns, send_stream || send_datagram, ts);
 
-    if (conn_should_send_max_data(conn)) {
-      rv = ngtcp2_frame_chain_objalloc_new(&nfrc, &conn->frc_objalloc);
+    if (!defer_flow_update && conn_should_send_max_data(conn)) {
+      rv = ngtcp2_frame_chain_objalloc_new(&nfrc, conn->frc_objalloc);
       if (rv != 0) {
         return rv;
       }
 
       if (conn->local.settings.max_window &&
-          conn->tx.last_max_data_ts != UINT64_MAX &&
-          ts - conn->tx.last_max_data_ts <
-              NGTCP2_FLOW_WINDOW_RTT_FACTOR * cstat->smoothed_rtt &&
-          conn->local.settings.max_window > conn->rx.window) {
-        target_max_data = NGTCP2_FLOW_WINDOW_SCALING_FACTOR * conn->rx.window;
-        if (target_max_data > conn->local.settings.max_window) {
-          target_max_data = conn->local.settings.max_window;
-        }
+          conn->tx.last_max_data_ts != UINT64_MAX) {
+        target_max_data = conn_flow_window_target(
+            conn->rx.window, conn->local.settings.max_window,
+            conn->rx.unsent_max_offset - conn->rx.max_offset,
+            ts - conn->tx.last_max_data_ts, cstat->smoothed_rtt);
+      } else {
+        target_max_data = conn->rx.window;
+      }
 
+      if (target_max_data > conn->rx.window) {
         delta = target_max_data - conn->rx.window;
         if (conn->rx.unsent_max_offset + delta > NGTCP2_MAX_VARINT) {
           delta = NGTCP2_MAX_VARINT - conn->rx.unsent_max_offset;
@@ -3623,7 +4817,11 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
 
     ngtcp2_ppe_init(ppe, dest, destlen, cc);
 
-    rv = ngtcp2_ppe_encode_hd(ppe, hd);
+    if (type == NGTCP2_PKT_1RTT) {
+      rv = ngtcp2_ppe_encode_hd_tmpl(ppe, &conn->pkt.hd_tmpl, hd);
+    } else {
+      rv = ngtcp2_ppe_encode_hd(ppe, hd);
+    }
     if (rv != 0) {
       assert(NGTCP2_ERR_NOBUF == rv);
       return 0;
@@ -3633,6 +4831,12 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
       return 0;
     }
 
+    if (type == NGTCP2_PKT_1RTT && send_stream &&
+        conn_stream_only_pkt(conn, ts)) {
+      pfrc = &pktns->tx.frq;
+      goto write_stream;
+    }
+
     if (ngtcp2_ringbuf_len(&conn->rx.path_challenge.rb)) {
       pcent = ngtcp2_ringbuf_get(&conn->rx.path_challenge.rb, 0);
 
@@ -3652,7 +4856,7 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
           pkt_empty = 0;
           rtb_entry_flags |= NGTCP2_RTB_ENTRY_FLAG_ACK_ELICITING;
           require_padding =
-              !conn->server || destlen >= NGTCP2_MAX_UDP_PAYLOAD_SIZE;
+              !conn_is_server(conn) || destlen >= NGTCP2_MAX_UDP_PAYLOAD_SIZE;
           /* We don't retransmit PATH_RESPONSE. */
         }
       }
@@ -3671,6 +4875,7 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
       if (rv != 0) {
         assert(NGTCP2_ERR_NOBUF == rv);
       } else {
+        conn_record_ack_delay(conn, &pktns->acktr, ts);
         ngtcp2_acktr_commit_ack(&pktns->acktr);
         ngtcp2_acktr_add_ack(&pktns->acktr, hd->pkt_num,
                              ackfr->ack.largest_ack);
@@ -3688,7 +4893,7 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
           ((*pfrc)->binder->flags & NGTCP2_FRAME_CHAIN_BINDER_FLAG_ACK)) {
         frc = *pfrc;
         *pfrc = (*pfrc)->next;
-        ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
+        ngtcp2_frame_chain_objalloc_del(frc, conn->frc_objalloc, conn->mem);
         continue;
       }
 
@@ -3699,7 +4904,7 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
         if (strm == NULL || (strm->flags & NGTCP2_STRM_FLAG_SHUT_RD)) {
           frc = *pfrc;
           *pfrc = (*pfrc)->next;
-          ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
+          ngtcp2_frame_chain_objalloc_del(frc, conn->frc_objalloc, conn->mem);
           continue;
         }
 
@@ -3724,7 +4929,7 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
             conn->remote.bidi.max_streams) {
           frc = *pfrc;
           *pfrc = (*pfrc)->next;
-          ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
+          ngtcp2_frame_chain_objalloc_del(frc, conn->frc_objalloc, conn->mem);
           continue;
         }
         break;
@@ -3733,7 +4938,7 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
             conn->remote.uni.max_streams) {
           frc = *pfrc;
           *pfrc = (*pfrc)->next;
-          ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
+          ngtcp2_frame_chain_objalloc_del(frc, conn->frc_objalloc, conn->mem);
           continue;
         }
         break;
@@ -3744,7 +4949,7 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
             (*pfrc)->fr.max_stream_data.max_stream_data < strm->rx.max_offset) {
           frc = *pfrc;
           *pfrc = (*pfrc)->next;
-          ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
+          ngtcp2_frame_chain_objalloc_del(frc, conn->frc_objalloc, conn->mem);
           continue;
         }
         break;
@@ -3752,7 +4957,7 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
         if ((*pfrc)->fr.max_data.max_data < conn->rx.max_offset) {
           frc = *pfrc;
           *pfrc = (*pfrc)->next;
-          ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
+          ngtcp2_frame_chain_objalloc_del(frc, conn->frc_objalloc, conn->mem);
           continue;
         }
         break;
@@ -3775,7 +4980,7 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
     }
 
     if (rv != NGTCP2_ERR_NOBUF) {
-      for (; ngtcp2_ksl_len(&pktns->crypto.tx.frq);) {
+      for (; pktns->crypto.tx.frq.len;) {
         left = ngtcp2_ppe_left(ppe);
 
         crypto_offset = conn_cryptofrq_unacked_offset(conn, pktns);
@@ -3818,7 +5023,7 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
     /* Write MAX_STREAM_ID after RESET_STREAM so that we can extend stream
        ID space in one packet. */
     if (rv != NGTCP2_ERR_NOBUF && *pfrc == NULL &&
-        conn->remote.bidi.unsent_max_streams > conn->remote.bidi.max_streams) {
+        conn_should_send_max_streams_bidi(conn)) {
       rv = conn_call_extend_max_remote_streams_bidi(
           conn, conn->remote.bidi.unsent_max_streams);
       if (rv != 0) {
@@ -3826,7 +5031,7 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
         return rv;
       }
 
-      rv = ngtcp2_frame_chain_objalloc_new(&nfrc, &conn->frc_objalloc);
+      rv = ngtcp2_frame_chain_objalloc_new(&nfrc, conn->frc_objalloc);
       if (rv != 0) {
         assert(ngtcp2_err_is_fatal(rv));
         return rv;
@@ -3836,6 +5041,7 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
       *pfrc = nfrc;
 
       conn->remote.bidi.max_streams = conn->remote.bidi.unsent_max_streams;
+      conn->remote.bidi.blocked = 0;
 
       rv = conn_ppe_write_frame_hd_log(conn, ppe, &hd_logged, hd, &(*pfrc)->fr);
       if (rv != 0) {
@@ -3850,7 +5056,7 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
     }
 
     if (rv != NGTCP2_ERR_NOBUF && *pfrc == NULL) {
-      if (conn->remote.uni.unsent_max_streams > conn->remote.uni.max_streams) {
+      if (conn_should_send_max_streams_uni(conn)) {
         rv = conn_call_extend_max_remote_streams_uni(
             conn, conn->remote.uni.unsent_max_streams);
         if (rv != 0) {
@@ -3858,7 +5064,7 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
           return rv;
         }
 
-        rv = ngtcp2_frame_chain_objalloc_new(&nfrc, &conn->frc_objalloc);
+        rv = ngtcp2_frame_chain_objalloc_new(&nfrc, conn->frc_objalloc);
         if (rv != 0) {
           assert(ngtcp2_err_is_fatal(rv));
           return rv;
@@ -3868,6 +5074,7 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
         *pfrc = nfrc;
 
         conn->remote.uni.max_streams = conn->remote.uni.unsent_max_streams;
+        conn->remote.uni.blocked = 0;
 
         rv = conn_ppe_write_frame_hd_log(conn, ppe, &hd_logged, hd,
                                          &(*pfrc)->fr);
@@ -3883,29 +5090,75 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
       }
     }
 
-    if (rv != NGTCP2_ERR_NOBUF) {
-      for (; !ngtcp2_pq_empty(&conn->tx.strmq);) {
+    if (rv != NGTCP2_ERR_NOBUF && *pfrc == NULL && type == NGTCP2_PKT_1RTT) {
+      for (; conn->tx.repairq;) {
+        nfrc = conn->tx.repairq;
+
+        if (conn_repair_obsolete(conn, &nfrc->fr.repair)) {
+          conn->tx.repairq = nfrc->next;
+          ngtcp2_frame_chain_objalloc_del(nfrc, conn->frc_objalloc,
+                                          conn->mem);
+          continue;
+        }
+
+        rv = conn_ppe_write_frame_hd_log(conn, ppe, &hd_logged, hd,
+                                         &nfrc->fr);
+        if (rv != 0) {
+          assert(NGTCP2_ERR_NOBUF == rv);
+          /* REPAIR frame is large.  Send it in the next packet, and
+             fill this packet with the other frames. */
+          rv = 0;
+          break;
+        }
+
+        conn->tx.repairq = nfrc->next;
+        nfrc->next = NULL;
+        *pfrc = nfrc;
+        pfrc = &nfrc->next;
+
+        pkt_empty = 0;
+        rtb_entry_flags |= NGTCP2_RTB_ENTRY_FLAG_ACK_ELICITING;
+      }
+    }
+
+    if (rv != NGTCP2_ERR_NOBUF && *pfrc == NULL && type == NGTCP2_PKT_1RTT &&
+        conn->tx.dgramq) {
+      if (conn_retransmit_first(conn)) {
+        dgramq_deferred = 1;
+      } else {
+        rv = conn_write_dgramq(conn, ppe, &hd_logged, hd, &pfrc, &pkt_empty,
+                               &rtb_entry_flags, ts);
+        if (rv != 0) {
+          assert(ngtcp2_err_is_fatal(rv));
+          return rv;
+        }
+      }
+    }
+
+    if (rv != NGTCP2_ERR_NOBUF && !defer_flow_update) {
+      for (; !ngtcp2_conn_tx_strmq_empty(conn);) {
         strm = ngtcp2_conn_tx_strmq_top(conn);
 
         if (!(strm->flags & NGTCP2_STRM_FLAG_SHUT_RD) &&
             conn_should_send_max_stream_data(conn, strm)) {
-          rv = ngtcp2_frame_chain_objalloc_new(&nfrc, &conn->frc_objalloc);
+          rv = ngtcp2_frame_chain_objalloc_new(&nfrc, conn->frc_objalloc);
           if (rv != 0) {
             assert(ngtcp2_err_is_fatal(rv));
             return rv;
           }
 
           if (conn->local.settings.max_stream_window &&
-              strm->tx.last_max_stream_data_ts != UINT64_MAX &&
-              ts - strm->tx.last_max_stream_data_ts <
-                  NGTCP2_FLOW_WINDOW_RTT_FACTOR * cstat->smoothed_rtt &&
-              conn->local.settings.max_stream_window > strm->rx.window) {
-            target_max_data =
-                NGTCP2_FLOW_WINDOW_SCALING_FACTOR * strm->rx.window;
-            if (target_max_data > conn->local.settings.max_stream_window) {
-              target_max_data = conn->local.settings.max_stream_window;
-            }
+              !conn_mem_budget_exceeded(conn) &&
+              strm->tx.last_max_stream_data_ts != UINT64_MAX) {
+            target_max_data = conn_flow_window_target(
+                strm->rx.window, conn->local.settings.max_stream_window,
+                strm->rx.unsent_max_offset - strm->rx.max_offset,
+                ts - strm->tx.last_max_stream_data_ts, cstat->smoothed_rtt);
+          } else {
+            target_max_data = strm->rx.window;
+          }
 
+          if (target_max_data > strm->rx.window) {
             delta = target_max_data - strm->rx.window;
             if (strm->rx.unsent_max_offset + delta > NGTCP2_MAX_VARINT) {
               delta = NGTCP2_MAX_VARINT - strm->rx.unsent_max_offset;
@@ -4002,17 +5255,36 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
           return rv;
         }
       }
+
+      if (ngtcp2_conn_tx_strmq_empty(conn)) {
+        conn->tx.flow_update.first_ts = UINT64_MAX;
+        conn->tx.flow_update.urgent = 0;
+      }
+    }
+
+    /* The lost stream data have all been written.  Fill the rest of
+       the packet with the DATAGRAM frames which waited for them. */
+    if (dgramq_deferred && rv != NGTCP2_ERR_NOBUF &&
+        !conn_retransmit_first(conn) && conn->tx.dgramq) {
+      rv = conn_write_dgramq(conn, ppe, &hd_logged, hd, &pfrc, &pkt_empty,
+                             &rtb_entry_flags, ts);
+      if (rv != 0) {
+        assert(ngtcp2_err_is_fatal(rv));
+        return rv;
+      }
     }
 
     if (rv != NGTCP2_ERR_NOBUF && !send_stream && !send_datagram &&
         !(rtb_entry_flags & NGTCP2_RTB_ENTRY_FLAG_ACK_ELICITING) &&
         pktns->rtb.num_retransmittable && pktns->tx.frq == NULL &&
         pktns->rtb.probe_pkt_left) {
-      num_reclaimed = ngtcp2_rtb_reclaim_on_pto(&pktns->rtb, conn, pktns, 1);
+      num_reclaimed =
+          ngtcp2_rtb_reclaim_on_pto(&pktns->rtb, conn, pktns, 1, 0);
       if (num_reclaimed < 0) {
         return rv;
       }
       if (num_reclaimed) {
+        pto_reclaimed = 1;
         goto build_pkt;
       }
 
@@ -4030,16 +5302,32 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
   } else {
     pfrc = conn->pkt.pfrc;
     rtb_entry_flags |= conn->pkt.rtb_entry_flags;
+    pto_reclaimed = conn->pkt.pto_reclaimed;
     pkt_empty = conn->pkt.pkt_empty;
     hd_logged = conn->pkt.hd_logged;
   }
 
+write_stream:
   left = ngtcp2_ppe_left(ppe);
+  stream_left = left;
+
+  if (send_stream && type == NGTCP2_PKT_1RTT && vmsg->stream.strm->tx.fec &&
+      (fec_max_symbollen = conn_fec_max_symbollen(conn)) != 0) {
+    /* Leave the room for REPAIR frame so that the REPAIR frame of
+       the full sized STREAM frames fits in a packet. */
+    stream_left = left > NGTCP2_FEC_REPAIR_OVERHEAD
+                      ? left - NGTCP2_FEC_REPAIR_OVERHEAD
+                      : 0;
+    ndatalen = ngtcp2_min(ndatalen, fec_max_symbollen);
+  } else {
+    fec_max_symbollen = 0;
+  }
 
   if (rv != NGTCP2_ERR_NOBUF && send_stream && *pfrc == NULL &&
+      !conn_retransmit_first(conn) &&
       (ndatalen = ngtcp2_pkt_stream_max_datalen(
            vmsg->stream.strm->stream_id, vmsg->stream.strm->tx.offset, ndatalen,
-           left)) != (size_t)-1 &&
+           stream_left)) != (size_t)-1 &&
       (ndatalen || datalen == 0)) {
     datacnt = ngtcp2_vec_copy_at_most(data, NGTCP2_MAX_STREAM_DATACNT,
                                       vmsg->stream.data, vmsg->stream.datacnt,
@@ -4049,7 +5337,7 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
     assert((datacnt == 0 && datalen == 0) || (datacnt && datalen));
 
     rv = ngtcp2_frame_chain_stream_datacnt_objalloc_new(
-        &nfrc, datacnt, &conn->frc_objalloc, conn->mem);
+        &nfrc, datacnt, conn->frc_objalloc, conn->mem);
     if (rv != 0) {
       assert(ngtcp2_err_is_fatal(rv));
       return rv;
@@ -4079,11 +5367,33 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
                        NGTCP2_RTB_ENTRY_FLAG_PTO_ELICITING |
                        NGTCP2_RTB_ENTRY_FLAG_RETRANSMITTABLE;
 
+    if (fec_max_symbollen && ndatalen) {
+      rv = conn_fec_add_stream_frame(conn, vmsg->stream.strm,
+                                     &nfrc->fr.stream, ndatalen == datalen);
+      if (rv != 0) {
+        assert(ngtcp2_err_is_fatal(rv));
+        return rv;
+      }
+    }
+
     vmsg->stream.strm->tx.offset += ndatalen;
     conn->tx.offset += ndatalen;
 
+    if (conn->latency && ndatalen &&
+        vmsg->stream.strm->tx.offer_ts != UINT64_MAX) {
+      ngtcp2_latency_hist_add(&conn->latency->write_to_send,
+                              ts - vmsg->stream.strm->tx.offer_ts);
+      /* The rest of the data keep waiting since the first offer. */
+      if (ndatalen == datalen) {
+        vmsg->stream.strm->tx.offer_ts = UINT64_MAX;
+      }
+    }
+
     if (fin) {
       ngtcp2_strm_shutdown(vmsg->stream.strm, NGTCP2_STRM_FLAG_SHUT_WR);
+      ngtcp2_sched_remove(&conn->tx.sched, vmsg->stream.strm);
+    } else if (ngtcp2_sched_is_queued(vmsg->stream.strm)) {
+      ngtcp2_sched_update(&conn->tx.sched, vmsg->stream.strm, ndatalen);
     }
 
     if (vmsg->stream.pdatalen) {
@@ -4094,9 +5404,10 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
   }
 
   if (rv != NGTCP2_ERR_NOBUF && send_datagram &&
+      !conn_retransmit_first(conn) &&
       left >= ngtcp2_pkt_datagram_framelen((size_t)datalen)) {
     if (conn->callbacks.ack_datagram || conn->callbacks.lost_datagram) {
-      rv = ngtcp2_frame_chain_objalloc_new(&nfrc, &conn->frc_objalloc);
+      rv = ngtcp2_frame_chain_objalloc_new(&nfrc, conn->frc_objalloc);
       if (rv != 0) {
         assert(ngtcp2_err_is_fatal(rv));
         return rv;
@@ -4154,6 +5465,7 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
     conn->pkt.pfrc = pfrc;
     conn->pkt.pkt_empty = pkt_empty;
     conn->pkt.rtb_entry_flags = rtb_entry_flags;
+    conn->pkt.pto_reclaimed = pto_reclaimed;
     conn->pkt.hd_logged = hd_logged;
     conn->flags |= NGTCP2_CONN_FLAG_PPE_PENDING;
 
@@ -4184,8 +5496,16 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
 
   if (!(rtb_entry_flags & NGTCP2_RTB_ENTRY_FLAG_ACK_ELICITING)) {
     if (pktns->tx.num_non_ack_pkt >= NGTCP2_MAX_NON_ACK_TX_PKT ||
-        keep_alive_expired || conn->pktns.rtb.probe_pkt_left) {
-      lfr.type = NGTCP2_FRAME_PING;
+        keep_alive_expired || conn->pktns.rtb.probe_pkt_left ||
+        pmtud_probe) {
+      /* Ask the remote endpoint not to delay the acknowledgement of
+         the probe packet if it supports IMMEDIATE_ACK. */
+      if (conn->pktns.rtb.probe_pkt_left && conn->remote.transport_params &&
+          conn->remote.transport_params->min_ack_delay) {
+        lfr.type = NGTCP2_FRAME_IMMEDIATE_ACK;
+      } else {
+        lfr.type = NGTCP2_FRAME_PING;
+      }
 
       rv = conn_ppe_write_frame_hd_log(conn, ppe, &hd_logged, hd, &lfr);
       if (rv != 0) {
@@ -4206,9 +5526,14 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
     pktns->tx.num_non_ack_pkt = 0;
   }
 
+  if (pmtud_probe) {
+    rtb_entry_flags |= NGTCP2_RTB_ENTRY_FLAG_PTO_ELICITING |
+                       NGTCP2_RTB_ENTRY_FLAG_PMTUD_PROBE;
+  }
+
   /* TODO Push STREAM frame back to ngtcp2_strm if there is an error
      before ngtcp2_rtb_entry is safely created and added. */
-  if (require_padding ||
+  if (require_padding || pmtud_probe ||
       /* Making full sized packet will help GSO a bit */
       ngtcp2_ppe_left(ppe) < 10) {
     lfr.padding.len = ngtcp2_ppe_padding(ppe);
@@ -4223,7 +5548,16 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
     ngtcp2_qlog_write_frame(&conn->qlog, &lfr);
   }
 
-  nwrite = ngtcp2_ppe_final(ppe, NULL);
+  perf_phase = ngtcp2_perf_switch(&conn->perf, NGTCP2_PERF_PHASE_ENCRYPT);
+  if (type == NGTCP2_PKT_1RTT &&
+      (flags & NGTCP2_WRITE_PKT_FLAG_CRYPTO_OFFLOAD)) {
+    nwrite = conn_ppe_final_offload(conn, pi, ppe);
+  } else if (type == NGTCP2_PKT_1RTT && conn->callbacks.encrypt_batch) {
+    nwrite = conn_ppe_final_deferred(conn, ppe);
+  } else {
+    nwrite = ngtcp2_ppe_final(ppe, NULL);
+  }
+  ngtcp2_perf_switch(&conn->perf, perf_phase);
   if (nwrite < 0) {
     assert(ngtcp2_err_is_fatal((int)nwrite));
     return nwrite;
@@ -4232,17 +5566,18 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
   ++cc->ckm->use_count;
 
   ngtcp2_qlog_pkt_sent_end(&conn->qlog, hd, (size_t)nwrite);
+  NGTCP2_PROBE4(pkt_sent, conn, hd->pkt_num, hd->type, nwrite);
 
   /* TODO ack-eliciting vs needs-tracking */
   /* probe packet needs tracking but it does not need ACK, could be lost. */
   if ((rtb_entry_flags & NGTCP2_RTB_ENTRY_FLAG_ACK_ELICITING) || padded) {
-    if (pi) {
+    if (pi && !pmtud_probe) {
       conn_handle_tx_ecn(conn, pi, &rtb_entry_flags, pktns, hd, ts);
     }
 
     rv = ngtcp2_rtb_entry_objalloc_new(&ent, hd, NULL, ts, (size_t)nwrite,
                                        rtb_entry_flags,
-                                       &conn->rtb_entry_objalloc);
+                                       conn->rtb_entry_objalloc);
     if (rv != 0) {
       assert(ngtcp2_err_is_fatal((int)nwrite));
       return rv;
@@ -4263,18 +5598,20 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
     rv = conn_on_pkt_sent(conn, &pktns->rtb, ent);
     if (rv != 0) {
       assert(ngtcp2_err_is_fatal(rv));
-      ngtcp2_rtb_entry_objalloc_del(ent, &conn->rtb_entry_objalloc,
-                                    &conn->frc_objalloc, conn->mem);
+      ngtcp2_rtb_entry_objalloc_del(ent, conn->rtb_entry_objalloc,
+                                    conn->frc_objalloc, conn->mem);
       return rv;
     }
 
     if (rtb_entry_flags & NGTCP2_RTB_ENTRY_FLAG_ACK_ELICITING) {
       if (conn->cc.on_pkt_sent) {
+        perf_phase = ngtcp2_perf_switch(&conn->perf, NGTCP2_PERF_PHASE_CC);
         conn->cc.on_pkt_sent(
             &conn->cc, &conn->cstat,
             ngtcp2_cc_pkt_init(&cc_pkt, hd->pkt_num, (size_t)nwrite,
                                NGTCP2_PKTNS_ID_APPLICATION, ts, ent->rst.lost,
                                ent->rst.tx_in_flight, ent->rst.is_app_limited));
+        ngtcp2_perf_switch(&conn->perf, perf_phase);
       }
 
       if (conn->flags & NGTCP2_CONN_FLAG_RESTART_IDLE_TIMER_ON_WRITE) {
@@ -4291,8 +5628,13 @@ static ngtcp2_ssize conn_write_pkt(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
       (rtb_entry_flags & NGTCP2_RTB_ENTRY_FLAG_ACK_ELICITING)) {
     --pktns->rtb.probe_pkt_left;
 
-    ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_CON, "probe pkt size=%td",
-                    nwrite);
+    ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_CON,
+                    "probe pkt size=%td retransmission=%d", nwrite,
+                    pto_reclaimed);
+
+    ngtcp2_qlog_pto_probe_sent(&conn->qlog, hd->pkt_num,
+                               conn->local.settings.pto_probe_policy,
+                               pto_reclaimed);
   }
 
   conn_update_keep_alive_last_ts(conn, ts);
@@ -4324,6 +5666,7 @@ ngtcp2_ssize ngtcp2_conn_write_single_frame_pkt(
   int padded = 0;
   const ngtcp2_cid *scid;
   uint32_t version;
+  ngtcp2_perf_phase perf_phase;
 
   switch (type) {
   case NGTCP2_PKT_INITIAL:
@@ -4368,6 +5711,8 @@ ngtcp2_ssize ngtcp2_conn_write_single_frame_pkt(
   cc.hp = pktns->crypto.ctx.hp;
   cc.encrypt = conn->callbacks.encrypt;
   cc.hp_mask = conn->callbacks.hp_mask;
+  cc.encrypt_hp_mask = conn->callbacks.encrypt_hp_mask;
+  cc.encrypt_vec = conn->callbacks.encrypt_vec;
 
   ngtcp2_pkt_hd_init(&hd, hd_flags, type, dcid, scid,
                      pktns->tx.last_pkt_num + 1, pktns_select_pkt_numlen(pktns),
@@ -4375,7 +5720,11 @@ ngtcp2_ssize ngtcp2_conn_write_single_frame_pkt(
 
   ngtcp2_ppe_init(&ppe, dest, destlen, &cc);
 
-  rv = ngtcp2_ppe_encode_hd(&ppe, &hd);
+  if (type == NGTCP2_PKT_1RTT) {
+    rv = ngtcp2_ppe_encode_hd_tmpl(&ppe, &conn->pkt.hd_tmpl, &hd);
+  } else {
+    rv = ngtcp2_ppe_encode_hd(&ppe, &hd);
+  }
   if (rv != 0) {
     assert(NGTCP2_ERR_NOBUF == rv);
     return 0;
@@ -4401,7 +5750,7 @@ ngtcp2_ssize ngtcp2_conn_write_single_frame_pkt(
     switch (fr->type) {
     case NGTCP2_FRAME_PATH_CHALLENGE:
     case NGTCP2_FRAME_PATH_RESPONSE:
-      if (!conn->server || destlen >= NGTCP2_MAX_UDP_PAYLOAD_SIZE) {
+      if (!conn_is_server(conn) || destlen >= NGTCP2_MAX_UDP_PAYLOAD_SIZE) {
         lfr.padding.len = ngtcp2_ppe_padding(&ppe);
       } else {
         lfr.padding.len = 0;
@@ -4422,7 +5771,9 @@ ngtcp2_ssize ngtcp2_conn_write_single_frame_pkt(
     ngtcp2_qlog_write_frame(&conn->qlog, &lfr);
   }
 
+  perf_phase = ngtcp2_perf_switch(&conn->perf, NGTCP2_PERF_PHASE_ENCRYPT);
   nwrite = ngtcp2_ppe_final(&ppe, NULL);
+  ngtcp2_perf_switch(&conn->perf, perf_phase);
   if (nwrite < 0) {
     return nwrite;
   }
@@ -4432,11 +5783,13 @@ ngtcp2_ssize ngtcp2_conn_write_single_frame_pkt(
   }
 
   ngtcp2_qlog_pkt_sent_end(&conn->qlog, &hd, (size_t)nwrite);
+  NGTCP2_PROBE4(pkt_sent, conn, hd.pkt_num, hd.type, nwrite);
 
   /* Do this when we are sure that there is no error. */
   switch (fr->type) {
   case NGTCP2_FRAME_ACK:
   case NGTCP2_FRAME_ACK_ECN:
+    conn_record_ack_delay(conn, &pktns->acktr, ts);
     ngtcp2_acktr_commit_ack(&pktns->acktr);
     ngtcp2_acktr_add_ack(&pktns->acktr, hd.pkt_num, fr->ack.largest_ack);
     if (type == NGTCP2_PKT_1RTT) {
@@ -4454,15 +5807,15 @@ ngtcp2_ssize ngtcp2_conn_write_single_frame_pkt(
 
     rv = ngtcp2_rtb_entry_objalloc_new(&rtbent, &hd, NULL, ts, (size_t)nwrite,
                                        rtb_entry_flags,
-                                       &conn->rtb_entry_objalloc);
+                                       conn->rtb_entry_objalloc);
     if (rv != 0) {
       return rv;
     }
 
     rv = conn_on_pkt_sent(conn, &pktns->rtb, rtbent);
     if (rv != 0) {
-      ngtcp2_rtb_entry_objalloc_del(rtbent, &conn->rtb_entry_objalloc,
-                                    &conn->frc_objalloc, conn->mem);
+      ngtcp2_rtb_entry_objalloc_del(rtbent, conn->rtb_entry_objalloc,
+                                    conn->frc_objalloc, conn->mem);
       return rv;
     }
 
@@ -4503,11 +5856,11 @@ ngtcp2_ssize ngtcp2_conn_write_single_frame_pkt(
 static void conn_process_early_rtb(ngtcp2_conn *conn) {
   ngtcp2_rtb_entry *ent;
   ngtcp2_rtb *rtb = &conn->pktns.rtb;
-  ngtcp2_ksl_it it;
+  ngtcp2_rtb_it it;
 
-  for (it = ngtcp2_rtb_head(rtb); !ngtcp2_ksl_it_end(&it);
-       ngtcp2_ksl_it_next(&it)) {
-    ent = ngtcp2_ksl_it_get(&it);
+  for (it = ngtcp2_rtb_head(rtb); !ngtcp2_rtb_it_end(&it);
+       ngtcp2_rtb_it_next(&it)) {
+    ent = ngtcp2_rtb_it_get(&it);
 
     if ((ent->hd.flags & NGTCP2_PKT_FLAG_LONG_FORM) == 0 ||
         ent->hd.type != NGTCP2_PKT_0RTT) {
@@ -4531,9 +5884,9 @@ static int conn_handshake_remnants_left(ngtcp2_conn *conn) {
 
   return !conn_is_handshake_completed(conn) ||
          (in_pktns && (in_pktns->rtb.num_pto_eliciting ||
-                       ngtcp2_ksl_len(&in_pktns->crypto.tx.frq))) ||
+                       in_pktns->crypto.tx.frq.len)) ||
          (hs_pktns && (hs_pktns->rtb.num_pto_eliciting ||
-                       ngtcp2_ksl_len(&hs_pktns->crypto.tx.frq)));
+                       hs_pktns->crypto.tx.frq.len));
 }
 
 /*
@@ -4558,7 +5911,7 @@ static int conn_retire_dcid_seq(ngtcp2_conn *conn, uint64_t seq) {
     return rv;
   }
 
-  rv = ngtcp2_frame_chain_objalloc_new(&nfrc, &conn->frc_objalloc);
+  rv = ngtcp2_frame_chain_objalloc_new(&nfrc, conn->frc_objalloc);
   if (rv != 0) {
     return rv;
   }
@@ -4695,7 +6048,11 @@ static int conn_start_pmtud(ngtcp2_conn *conn) {
 
   rv = ngtcp2_pmtud_new(&conn->pmtud, conn->dcid.current.max_udp_payload_size,
                         hard_max_udp_payload_size,
-                        conn->pktns.tx.last_pkt_num + 1, conn->mem);
+                        conn->pktns.tx.last_pkt_num + 1,
+                        conn->local.settings.pmtud_search
+                            ? NGTCP2_PMTUD_FLAG_SEARCH
+                            : NGTCP2_PMTUD_FLAG_NONE,
+                        conn->mem);
   if (rv != 0) {
     return rv;
   }
@@ -4708,10 +6065,14 @@ static int conn_start_pmtud(ngtcp2_conn *conn) {
 }
 
 int ngtcp2_conn_start_pmtud(ngtcp2_conn *conn) {
+  conn_invalidate_expiry(conn);
+
   return conn_start_pmtud(conn);
 }
 
 void ngtcp2_conn_stop_pmtud(ngtcp2_conn *conn) {
+  conn_invalidate_expiry(conn);
+
   if (!conn->pmtud) {
     return;
   }
@@ -4721,11 +6082,48 @@ void ngtcp2_conn_stop_pmtud(ngtcp2_conn *conn) {
   conn->pmtud = NULL;
 }
 
+int ngtcp2_conn_detect_pmtud_black_hole(ngtcp2_conn *conn, int64_t pkt_num,
+                                        size_t pktlen) {
+  size_t max_udp_payload_size = conn->dcid.current.max_udp_payload_size;
+
+  if (conn->local.settings.no_udp_payload_size_shaping ||
+      max_udp_payload_size <= NGTCP2_MAX_UDP_PAYLOAD_SIZE ||
+      pktlen <= NGTCP2_MAX_UDP_PAYLOAD_SIZE ||
+      pkt_num <= conn->pmtud_bh.max_ack_pkt_num) {
+    return 0;
+  }
+
+  if (++conn->pmtud_bh.num_lost < NGTCP2_PMTUD_BLACK_HOLE_THRESHOLD) {
+    return 0;
+  }
+
+  ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_CON,
+                  "PMTUD black hole detected; max_udp_payload_size=%zu is "
+                  "lowered to %d",
+                  max_udp_payload_size, NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+
+  conn->dcid.current.max_udp_payload_size = NGTCP2_MAX_UDP_PAYLOAD_SIZE;
+
+  /* The packets which are already in flight are likely to be lost as
+     well.  Do not count them again. */
+  conn->pmtud_bh.num_lost = 0;
+  conn->pmtud_bh.max_ack_pkt_num = conn->pktns.tx.last_pkt_num;
+
+  ngtcp2_conn_stop_pmtud(conn);
+
+  if (conn->local.settings.no_pmtud) {
+    return 0;
+  }
+
+  return conn_start_pmtud(conn);
+}
+
 static ngtcp2_ssize conn_write_pmtud_probe(ngtcp2_conn *conn,
                                            ngtcp2_pkt_info *pi, uint8_t *dest,
-                                           size_t destlen, ngtcp2_tstamp ts) {
+                                           size_t destlen, ngtcp2_vmsg *vmsg,
+                                           ngtcp2_tstamp ts) {
   size_t probelen;
-  ngtcp2_ssize nwrite;
+  ngtcp2_ssize nwrite = 0;
   ngtcp2_frame lfr;
 
   assert(conn->pmtud);
@@ -4743,17 +6141,30 @@ static ngtcp2_ssize conn_write_pmtud_probe(ngtcp2_conn *conn,
   ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_CON,
                   "sending PMTUD probe packet len=%zu", probelen);
 
-  lfr.type = NGTCP2_FRAME_PING;
+  /* PTO probe packet must not be lost because it is too large, so
+     that it only carries PING. */
+  if (conn->local.settings.pmtud_probe_data &&
+      !conn->pktns.rtb.probe_pkt_left) {
+    nwrite = conn_write_pkt(conn, pi, dest, probelen, vmsg, NGTCP2_PKT_1RTT,
+                            NGTCP2_WRITE_PKT_FLAG_PMTUD_PROBE, ts);
+    if (nwrite < 0 && nwrite != NGTCP2_ERR_STREAM_DATA_BLOCKED) {
+      return nwrite;
+    }
+  }
 
-  nwrite = ngtcp2_conn_write_single_frame_pkt(
-      conn, pi, dest, probelen, NGTCP2_PKT_1RTT,
-      NGTCP2_WRITE_PKT_FLAG_REQUIRE_PADDING, &conn->dcid.current.cid, &lfr,
-      NGTCP2_RTB_ENTRY_FLAG_ACK_ELICITING |
-          NGTCP2_RTB_ENTRY_FLAG_PTO_ELICITING |
-          NGTCP2_RTB_ENTRY_FLAG_PMTUD_PROBE,
-      NULL, ts);
-  if (nwrite < 0) {
-    return nwrite;
+  if (nwrite <= 0) {
+    lfr.type = NGTCP2_FRAME_PING;
+
+    nwrite = ngtcp2_conn_write_single_frame_pkt(
+        conn, pi, dest, probelen, NGTCP2_PKT_1RTT,
+        NGTCP2_WRITE_PKT_FLAG_REQUIRE_PADDING, &conn->dcid.current.cid, &lfr,
+        NGTCP2_RTB_ENTRY_FLAG_ACK_ELICITING |
+            NGTCP2_RTB_ENTRY_FLAG_PTO_ELICITING |
+            NGTCP2_RTB_ENTRY_FLAG_PMTUD_PROBE,
+        NULL, ts);
+    if (nwrite < 0) {
+      return nwrite;
+    }
   }
 
   assert(nwrite);
@@ -4959,7 +6370,7 @@ static ngtcp2_ssize conn_write_path_challenge(ngtcp2_conn *conn,
 
   destlen = ngtcp2_min(destlen, NGTCP2_MAX_UDP_PAYLOAD_SIZE);
 
-  if (conn->server) {
+  if (conn_is_server(conn)) {
     if (!(pv->dcid.flags & NGTCP2_DCID_FLAG_PATH_VALIDATED)) {
       tx_left = conn_server_tx_left(conn, &pv->dcid);
       destlen = (size_t)ngtcp2_min((uint64_t)destlen, tx_left);
@@ -5045,7 +6456,7 @@ static ngtcp2_ssize conn_write_path_response(ngtcp2_conn *conn,
       }
     }
 
-    if (conn->server) {
+    if (conn_is_server(conn)) {
       break;
     }
 
@@ -5075,7 +6486,8 @@ static ngtcp2_ssize conn_write_path_response(ngtcp2_conn *conn,
 
   destlen = ngtcp2_min(destlen, NGTCP2_MAX_UDP_PAYLOAD_SIZE);
 
-  if (conn->server && !(dcid->flags & NGTCP2_DCID_FLAG_PATH_VALIDATED)) {
+  if (conn_is_server(conn) &&
+      !(dcid->flags & NGTCP2_DCID_FLAG_PATH_VALIDATED)) {
     tx_left = conn_server_tx_left(conn, dcid);
     destlen = (size_t)ngtcp2_min((uint64_t)destlen, tx_left);
     if (destlen == 0) {
@@ -5117,6 +6529,82 @@ ngtcp2_ssize ngtcp2_conn_write_pkt_versioned(ngtcp2_conn *conn,
       /* datav = */ NULL, /* datavcnt = */ 0, ts);
 }
 
+int ngtcp2_conn_protect_pkts(ngtcp2_conn *conn) {
+  return conn_protect_pkts(conn);
+}
+
+int ngtcp2_conn_detach_protect_job(ngtcp2_conn *conn,
+                                   ngtcp2_protect_job **pjob) {
+  ngtcp2_conn_protect *protect = conn->protect;
+  ngtcp2_protect_job *job;
+
+  if (!protect || protect->len == 0) {
+    *pjob = NULL;
+
+    return 0;
+  }
+
+  job = ngtcp2_mem_malloc(conn->mem, sizeof(*job));
+  if (!job) {
+    return NGTCP2_ERR_NOMEM;
+  }
+
+  job->cc = protect->cc;
+  job->encrypt_batch = conn->callbacks.encrypt_batch;
+  job->hp_mask_batch = conn->callbacks.hp_mask_batch;
+  ngtcp2_cpymem(job->pkts, protect->pkts, sizeof(job->pkts[0]) * protect->len);
+  job->len = protect->len;
+
+  protect->len = 0;
+
+  job->prev = NULL;
+  job->next = conn->protect_jobs;
+  if (job->next) {
+    job->next->prev = job;
+  }
+  conn->protect_jobs = job;
+
+  *pjob = job;
+
+  return 0;
+}
+
+int ngtcp2_protect_job_run(ngtcp2_protect_job *job) {
+  return ngtcp2_ppe_protect_deferred(&job->cc, job->encrypt_batch,
+                                     job->hp_mask_batch, &job->batch,
+                                     job->pkts, job->len);
+}
+
+void ngtcp2_conn_release_protect_job(ngtcp2_conn *conn,
+                                     ngtcp2_protect_job *job) {
+  ngtcp2_crypto_km *ckm;
+
+  if (!job) {
+    return;
+  }
+
+  if (job->prev) {
+    job->prev->next = job->next;
+  } else {
+    conn->protect_jobs = job->next;
+  }
+  if (job->next) {
+    job->next->prev = job->prev;
+  }
+
+  ckm = job->cc.ckm;
+
+  ngtcp2_mem_free(conn->mem, job);
+
+  /* The key has been discarded by key update while the job was
+     outstanding.  Delete it if no other job refers to it. */
+  if (ckm != conn->pktns.crypto.tx.ckm &&
+      !conn_protect_jobs_refer(conn, ckm)) {
+    conn_call_delete_crypto_aead_ctx(conn, &ckm->aead_ctx);
+    ngtcp2_crypto_km_del(ckm, conn->mem);
+  }
+}
+
 /*
  * conn_on_version_negotiation is called when Version Negotiation
  * packet is received.  The function decodes the data in the buffer
@@ -5195,25 +6683,15 @@ fin:
 }
 
 static uint64_t conn_tx_strmq_first_cycle(ngtcp2_conn *conn) {
-  ngtcp2_strm *strm;
-
-  if (ngtcp2_pq_empty(&conn->tx.strmq)) {
+  if (ngtcp2_conn_tx_strmq_empty(conn)) {
     return 0;
   }
 
-  strm = ngtcp2_struct_of(ngtcp2_pq_top(&conn->tx.strmq), ngtcp2_strm, pe);
-  return strm->cycle;
+  return ngtcp2_conn_tx_strmq_top(conn)->cycle;
 }
 
 uint64_t ngtcp2_conn_tx_strmq_first_cycle(ngtcp2_conn *conn) {
-  ngtcp2_strm *strm;
-
-  if (ngtcp2_pq_empty(&conn->tx.strmq)) {
-    return 0;
-  }
-
-  strm = ngtcp2_struct_of(ngtcp2_pq_top(&conn->tx.strmq), ngtcp2_strm, pe);
-  return strm->cycle;
+  return conn_tx_strmq_first_cycle(conn);
 }
 
 int ngtcp2_conn_resched_frames(ngtcp2_conn *conn, ngtcp2_pktns *pktns,
@@ -5240,13 +6718,13 @@ int ngtcp2_conn_resched_frames(ngtcp2_conn *conn, ngtcp2_pktns *pktns,
 
       strm = ngtcp2_conn_find_stream(conn, sfr->stream_id);
       if (!strm) {
-        ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
+        ngtcp2_frame_chain_objalloc_del(frc, conn->frc_objalloc, conn->mem);
         break;
       }
       streamfrq_empty = ngtcp2_strm_streamfrq_empty(strm);
       rv = ngtcp2_strm_streamfrq_push(strm, frc);
       if (rv != 0) {
-        ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
+        ngtcp2_frame_chain_objalloc_del(frc, conn->frc_objalloc, conn->mem);
         return rv;
       }
       if (!ngtcp2_strm_is_tx_queued(strm)) {
@@ -5266,13 +6744,7 @@ int ngtcp2_conn_resched_frames(ngtcp2_conn *conn, ngtcp2_pktns *pktns,
       *pfrc = frc->next;
       frc->next = NULL;
 
-      rv = ngtcp2_ksl_insert(&pktns->crypto.tx.frq, NULL,
-                             &frc->fr.crypto.offset, frc);
-      if (rv != 0) {
-        assert(ngtcp2_err_is_fatal(rv));
-        ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
-        return rv;
-      }
+      ngtcp2_cryptofrq_push(&pktns->crypto.tx.frq, frc);
       break;
     default:
       pfrc = &(*pfrc)->next;
@@ -5344,7 +6816,7 @@ static int conn_on_retry(ngtcp2_conn *conn, const ngtcp2_pkt_hd *hd,
     return NGTCP2_ERR_PROTO;
   }
 
-  if (ngtcp2_cid_eq(&conn->dcid.current.cid, &hd->scid)) {
+  if (ngtcp2_cid_eq_inline(&conn->dcid.current.cid, &hd->scid)) {
     return 0;
   }
 
@@ -5399,7 +6871,95 @@ static int conn_on_retry(ngtcp2_conn *conn, const ngtcp2_pkt_hd *hd,
 
 int ngtcp2_conn_detect_lost_pkt(ngtcp2_conn *conn, ngtcp2_pktns *pktns,
                                 ngtcp2_conn_stat *cstat, ngtcp2_tstamp ts) {
-  return ngtcp2_rtb_detect_lost_pkt(&pktns->rtb, conn, pktns, cstat, ts);
+  ngtcp2_perf_phase perf_phase =
+      ngtcp2_perf_switch(&conn->perf, NGTCP2_PERF_PHASE_LOSS_DETECTION);
+  int rv = ngtcp2_rtb_detect_lost_pkt(&pktns->rtb, conn, pktns, cstat, ts);
+
+  ngtcp2_perf_switch(&conn->perf, perf_phase);
+
+  return rv;
+}
+
+/*
+ * conn_cc_resume_on_ack drives Careful Resume when an acknowledgement
+ * for 1RTT packets is received.
+ */
+static void conn_cc_resume_on_ack(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
+  ngtcp2_conn_stat *cstat = &conn->cstat;
+  const ngtcp2_cc_resume_params *params = &conn->cc_resume.params;
+  uint64_t jump_cwnd, pipesize;
+
+  switch (conn->cc_resume.phase) {
+  case NGTCP2_CC_RESUME_PHASE_RECONNAISSANCE:
+    if (!(conn->flags & NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED) ||
+        cstat->min_rtt == UINT64_MAX) {
+      return;
+    }
+
+    conn->cc_resume.phase = NGTCP2_CC_RESUME_PHASE_NONE;
+
+    if (cstat->min_rtt < params->min_rtt / 2 ||
+        cstat->min_rtt / 10 > params->min_rtt) {
+      ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_RCV,
+                      "cc resume abandoned min_rtt=%" PRIu64
+                      " saved_min_rtt=%" PRIu64,
+                      cstat->min_rtt / NGTCP2_MILLISECONDS,
+                      params->min_rtt / NGTCP2_MILLISECONDS);
+      return;
+    }
+
+    if (cstat->congestion_recovery_start_ts != UINT64_MAX) {
+      return;
+    }
+
+    jump_cwnd = params->cwnd / 2;
+    if (params->max_bw) {
+      jump_cwnd = ngtcp2_min(jump_cwnd, params->max_bw * params->min_rtt /
+                                            NGTCP2_SECONDS);
+    }
+
+    if (jump_cwnd <= cstat->cwnd) {
+      return;
+    }
+
+    ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_RCV,
+                    "cc resume cwnd=%" PRIu64 " jump_cwnd=%" PRIu64,
+                    cstat->cwnd, jump_cwnd);
+
+    cstat->cwnd = cstat->ssthresh = jump_cwnd;
+    cstat->pacing_rate =
+        (double)jump_cwnd / (double)ngtcp2_max(cstat->smoothed_rtt, 1);
+
+    conn->cc_resume.phase = NGTCP2_CC_RESUME_PHASE_UNVALIDATED;
+    conn->cc_resume.pkt_num = conn->pktns.tx.last_pkt_num + 1;
+    conn->cc_resume.delivered = conn->rst.delivered;
+    conn->cc_resume.ts = ts;
+
+    return;
+  case NGTCP2_CC_RESUME_PHASE_UNVALIDATED:
+    if (cstat->congestion_recovery_start_ts != UINT64_MAX &&
+        cstat->congestion_recovery_start_ts >= conn->cc_resume.ts) {
+      pipesize = conn->rst.delivered - conn->cc_resume.delivered;
+
+      cstat->cwnd = ngtcp2_min(
+          cstat->cwnd,
+          ngtcp2_max(pipesize / 2, 2 * cstat->max_udp_payload_size));
+      cstat->ssthresh = cstat->cwnd;
+
+      ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_RCV,
+                      "cc resume safe retreat cwnd=%" PRIu64, cstat->cwnd);
+    } else if (conn->pktns.rtb.largest_acked_tx_pkt_num <
+               conn->cc_resume.pkt_num) {
+      return;
+    }
+
+    conn->cc_resume.phase = NGTCP2_CC_RESUME_PHASE_NONE;
+    cstat->pacing_rate = 0.0;
+
+    return;
+  default:
+    return;
+  }
 }
 
 /*
@@ -5443,7 +7003,7 @@ static int conn_recv_ack(ngtcp2_conn *conn, ngtcp2_pktns *pktns, ngtcp2_ack *fr,
   if (num_acked < 0) {
     /* TODO assert this */
     assert(ngtcp2_err_is_fatal((int)num_acked));
-    ngtcp2_frame_chain_list_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
+    ngtcp2_frame_chain_list_objalloc_del(frc, conn->frc_objalloc, conn->mem);
     return (int)num_acked;
   }
 
@@ -5451,10 +7011,16 @@ static int conn_recv_ack(ngtcp2_conn *conn, ngtcp2_pktns *pktns, ngtcp2_ack *fr,
     return 0;
   }
 
+  if (conn->cc_resume.phase != NGTCP2_CC_RESUME_PHASE_NONE &&
+      pktns == &conn->pktns) {
+    conn_cc_resume_on_ack(conn, ts);
+  }
+
   pktns->rtb.probe_pkt_left = 0;
 
   if (cstat->pto_count &&
-      (conn->server || (conn->flags & NGTCP2_CONN_FLAG_SERVER_ADDR_VERIFIED))) {
+      (conn_is_server(conn) ||
+       (conn->flags & NGTCP2_CONN_FLAG_SERVER_ADDR_VERIFIED))) {
     /* Reset PTO count but no less than 2 to avoid frequent probe
        packet transmission. */
     cstat->pto_count = ngtcp2_min(cstat->pto_count, 2);
@@ -5535,13 +7101,13 @@ static int conn_recv_max_stream_data(ngtcp2_conn *conn,
       return 0;
     }
 
-    strm = ngtcp2_objalloc_strm_get(&conn->strm_objalloc);
+    strm = ngtcp2_objalloc_strm_get(conn->strm_objalloc);
     if (strm == NULL) {
       return NGTCP2_ERR_NOMEM;
     }
     rv = ngtcp2_conn_init_stream(conn, strm, fr->stream_id, NULL);
     if (rv != 0) {
-      ngtcp2_objalloc_strm_release(&conn->strm_objalloc, strm);
+      ngtcp2_objalloc_strm_release(conn->strm_objalloc, strm);
       return rv;
     }
 
@@ -5577,8 +7143,10 @@ static void conn_recv_max_data(ngtcp2_conn *conn, const ngtcp2_max_data *fr) {
 }
 
 /*
- * conn_buffer_pkt buffers |pkt| of length |pktlen|, chaining it from
- * |*ppc|.
+ * conn_buffer_pkt buffers |pkt| of length |pktlen|, chaining it to
+ * the end of pktns->rx.buffed_pkts.  The packet is copied into
+ * pktns->rx.buffed_pkts_buf.  If the buffer does not have enough
+ * space, the packet is dropped.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -5590,24 +7158,33 @@ static int conn_buffer_pkt(ngtcp2_conn *conn, ngtcp2_pktns *pktns,
                            const ngtcp2_path *path, const ngtcp2_pkt_info *pi,
                            const uint8_t *pkt, size_t pktlen, size_t dgramlen,
                            ngtcp2_tstamp ts) {
-  int rv;
-  ngtcp2_pkt_chain **ppc = &pktns->rx.buffed_pkts, *pc;
-  size_t i;
-  for (i = 0; *ppc && i < NGTCP2_MAX_NUM_BUFFED_RX_PKTS;
-       ppc = &(*ppc)->next, ++i)
-    ;
+  ngtcp2_buf *buf = &pktns->rx.buffed_pkts_buf;
+  ngtcp2_pkt_chain **ppc = &pktns->rx.buffed_pkts;
+  size_t objlen = ngtcp2_pkt_chain_objlen(pktlen);
+  uint8_t *p;
 
-  if (i == NGTCP2_MAX_NUM_BUFFED_RX_PKTS) {
-    return 0;
+  if (buf->begin == NULL) {
+    p = ngtcp2_mem_malloc(conn->mem, NGTCP2_BUFFED_RX_PKTS_BUFLEN);
+    if (p == NULL) {
+      return NGTCP2_ERR_NOMEM;
+    }
+
+    ngtcp2_buf_init(buf, p, NGTCP2_BUFFED_RX_PKTS_BUFLEN);
   }
 
-  rv =
-      ngtcp2_pkt_chain_new(&pc, path, pi, pkt, pktlen, dgramlen, ts, conn->mem);
-  if (rv != 0) {
-    return rv;
+  if (ngtcp2_buf_left(buf) < objlen) {
+    ++conn->cstat.undecryptable_pkt_dropped_count;
+
+    return 0;
   }
 
-  *ppc = pc;
+  for (; *ppc; ppc = &(*ppc)->next)
+    ;
+
+  *ppc = ngtcp2_pkt_chain_init(buf->last, path, pi, pkt, pktlen, dgramlen, ts);
+  buf->last += objlen;
+
+  ++conn->cstat.undecryptable_pkt_buffered_count;
 
   return 0;
 }
@@ -5706,11 +7283,120 @@ static ngtcp2_ssize decrypt_pkt(uint8_t *dest, const ngtcp2_crypto_aead *aead,
   return (ngtcp2_ssize)(payloadlen - aead->max_overhead);
 }
 
+/*
+ * rx_hp_sample_offset returns the offset to the header protection
+ * sample of 1RTT packet received by |conn|.
+ */
+static size_t rx_hp_sample_offset(ngtcp2_conn *conn) {
+  return 1 + conn->oscid.datalen + 4;
+}
+
+/*
+ * conn_find_rx_hp_mask returns the header protection mask of 1RTT
+ * packet |pkt| precomputed by ngtcp2_conn_prepare_rx_hp_masks.  It
+ * returns NULL if there is no such mask, or the sample has been
+ * altered since then.
+ */
+static const uint8_t *conn_find_rx_hp_mask(ngtcp2_conn *conn,
+                                           const uint8_t *pkt) {
+  ngtcp2_conn_rx_hp *rx_hp = conn->rx_hp;
+  size_t i;
+
+  if (!rx_hp) {
+    return NULL;
+  }
+
+  for (i = rx_hp->pos; i < rx_hp->len; ++i) {
+    if (rx_hp->pkts[i] != pkt) {
+      continue;
+    }
+
+    rx_hp->pos = i + 1;
+
+    if (memcmp(rx_hp->samples[i], pkt + rx_hp_sample_offset(conn),
+               NGTCP2_HP_SAMPLELEN) != 0) {
+      return NULL;
+    }
+
+    return rx_hp->masks + i * NGTCP2_HP_SAMPLELEN;
+  }
+
+  return NULL;
+}
+
+int ngtcp2_conn_prepare_rx_hp_masks(ngtcp2_conn *conn, const ngtcp2_vec *pktv,
+                                    size_t pktvcnt) {
+  ngtcp2_pktns *pktns = &conn->pktns;
+  const uint8_t *samples[NGTCP2_MAX_RX_HP_MASKS];
+  size_t sample_offset = rx_hp_sample_offset(conn);
+  ngtcp2_crypto_cipher *hp = &pktns->crypto.ctx.hp;
+  ngtcp2_crypto_cipher_ctx *hp_ctx = &pktns->crypto.rx.hp_ctx;
+  ngtcp2_conn_rx_hp *rx_hp = conn->rx_hp;
+  size_t i, n = 0;
+  int rv;
+
+  if (rx_hp) {
+    rx_hp->len = 0;
+    rx_hp->pos = 0;
+  }
+
+  if (!pktns->crypto.rx.ckm) {
+    return 0;
+  }
+
+  if (!rx_hp) {
+    rx_hp = ngtcp2_mem_malloc(conn->mem, sizeof(*rx_hp));
+    if (!rx_hp) {
+      return NGTCP2_ERR_NOMEM;
+    }
+
+    rx_hp->len = 0;
+    rx_hp->pos = 0;
+    conn->rx_hp = rx_hp;
+  }
+
+  for (i = 0; i < pktvcnt && n < NGTCP2_MAX_RX_HP_MASKS; ++i) {
+    if (pktv[i].len < sample_offset + NGTCP2_HP_SAMPLELEN ||
+        (pktv[i].base[0] & NGTCP2_HEADER_FORM_BIT)) {
+      continue;
+    }
+
+    rx_hp->pkts[n] = pktv[i].base;
+    samples[n] = pktv[i].base + sample_offset;
+    memcpy(rx_hp->samples[n], samples[n], NGTCP2_HP_SAMPLELEN);
+    ++n;
+  }
+
+  if (n == 0) {
+    return 0;
+  }
+
+  if (conn->callbacks.hp_mask_batch) {
+    rv = conn->callbacks.hp_mask_batch(rx_hp->masks, hp, hp_ctx, samples, n);
+    if (rv != 0) {
+      return NGTCP2_ERR_CALLBACK_FAILURE;
+    }
+  } else {
+    for (i = 0; i < n; ++i) {
+      rv = conn->callbacks.hp_mask(rx_hp->masks + i * NGTCP2_HP_SAMPLELEN, hp,
+                                   hp_ctx, samples[i]);
+      if (rv != 0) {
+        return NGTCP2_ERR_CALLBACK_FAILURE;
+      }
+    }
+  }
+
+  rx_hp->len = n;
+
+  return 0;
+}
+
 /*
  * decrypt_hp decryptes packet header.  The packet number starts at
  * |pkt| + |pkt_num_offset|.  The entire plaintext QUIC packet header
  * will be written to the buffer pointed by |dest| whose capacity is
- * |destlen|.
+ * |destlen|.  If |precomputed_mask| is not NULL, it is used as header
+ * protection mask instead of calling |hp_mask|.
  *
  * This function returns the number of bytes written to |dest|, or one
  * of the following negative error codes:
@@ -5724,10 +7410,12 @@ static ngtcp2_ssize decrypt_pkt(uint8_t *dest, const ngtcp2_crypto_aead *aead,
 static ngtcp2_ssize
 decrypt_hp(ngtcp2_pkt_hd *hd, uint8_t *dest, const ngtcp2_crypto_cipher *hp,
            const uint8_t *pkt, size_t pktlen, size_t pkt_num_offset,
-           const ngtcp2_crypto_cipher_ctx *hp_ctx, ngtcp2_hp_mask hp_mask) {
+           const ngtcp2_crypto_cipher_ctx *hp_ctx, ngtcp2_hp_mask hp_mask,
+           const uint8_t *precomputed_mask) {
   size_t sample_offset;
   uint8_t *p = dest;
-  uint8_t mask[NGTCP2_HP_SAMPLELEN];
+  uint8_t maskbuf[NGTCP2_HP_SAMPLELEN];
+  const uint8_t *mask = precomputed_mask;
   size_t i;
   int rv;
 
@@ -5741,9 +7429,13 @@ decrypt_hp(ngtcp2_pkt_hd *hd, uint8_t *dest, const ngtcp2_crypto_cipher *hp,
 
   sample_offset = pkt_num_offset + 4;
 
-  rv = hp_mask(mask, hp, hp_ctx, pkt + sample_offset);
-  if (rv != 0) {
-    return NGTCP2_ERR_CALLBACK_FAILURE;
+  if (!mask) {
+    rv = hp_mask(maskbuf, hp, hp_ctx, pkt + sample_offset);
+    if (rv != 0) {
+      return NGTCP2_ERR_CALLBACK_FAILURE;
+    }
+
+    mask = maskbuf;
   }
 
   if (hd->flags & NGTCP2_PKT_FLAG_LONG_FORM) {
@@ -5854,7 +7546,8 @@ static void conn_recv_path_challenge(ngtcp2_conn *conn, const ngtcp2_path *path,
 
   /* client only responds to PATH_CHALLENGE from the current path or
      path which client is migrating to. */
-  if (!conn->server && !ngtcp2_path_eq(&conn->dcid.current.ps.path, path) &&
+  if (!conn_is_server(conn) &&
+      !ngtcp2_path_eq(&conn->dcid.current.ps.path, path) &&
       (!conn->pv || !ngtcp2_path_eq(&conn->pv->dcid.ps.path, path))) {
     ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_CON,
                     "discard PATH_CHALLENGE from the path which is not current "
@@ -5867,36 +7560,144 @@ static void conn_recv_path_challenge(ngtcp2_conn *conn, const ngtcp2_path *path,
 }
 
 /*
- * conn_reset_congestion_state resets congestion state.
+ * conn_cc_resume_find_path returns the index of |path| in
+ * conn->cc_resume.paths.  It returns conn->cc_resume.npaths if it is
+ * not found.
  */
-static void conn_reset_congestion_state(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
-  conn_reset_conn_stat_cc(conn, &conn->cstat);
-
-  conn->cc.reset(&conn->cc, &conn->cstat, ts);
+static size_t conn_cc_resume_find_path(ngtcp2_conn *conn,
+                                       const ngtcp2_path *path) {
+  size_t i;
 
-  if (conn->hs_pktns) {
-    ngtcp2_rtb_reset_cc_state(&conn->hs_pktns->rtb,
-                              conn->hs_pktns->tx.last_pkt_num + 1);
+  for (i = 0; i < conn->cc_resume.npaths; ++i) {
+    if (ngtcp2_path_eq(&conn->cc_resume.paths[i].ps.path, path)) {
+      break;
+    }
   }
-  ngtcp2_rtb_reset_cc_state(&conn->pktns.rtb, conn->pktns.tx.last_pkt_num + 1);
-  ngtcp2_rst_init(&conn->rst);
 
-  conn->tx.pacing.next_ts = UINT64_MAX;
+  return i;
 }
 
-static int conn_recv_path_response(ngtcp2_conn *conn, ngtcp2_path_response *fr,
-                                   ngtcp2_tstamp ts) {
-  int rv;
-  ngtcp2_duration pto, timeout;
-  ngtcp2_pv *pv = conn->pv, *npv;
-  uint8_t ent_flags;
-
-  if (!pv) {
-    return 0;
+/*
+ * conn_cc_resume_remove_path removes the |i|-th element of
+ * conn->cc_resume.paths.
+ */
+static void conn_cc_resume_remove_path(ngtcp2_conn *conn, size_t i) {
+  for (; i + 1 < conn->cc_resume.npaths; ++i) {
+    conn->cc_resume.paths[i] = conn->cc_resume.paths[i + 1];
+    ngtcp2_path_storage_init2(&conn->cc_resume.paths[i].ps,
+                              &conn->cc_resume.paths[i + 1].ps.path);
   }
 
-  rv = ngtcp2_pv_validate(pv, &ent_flags, fr->data);
-  if (rv != 0) {
+  --conn->cc_resume.npaths;
+}
+
+/*
+ * conn_cc_resume_on_migration remembers the congestion control state
+ * of the path which the connection is migrating away from, and arms
+ * Careful Resume if the connection has used conn->dcid.current
+ * before.  This way, switching back and forth between paths, e.g.,
+ * Wi-Fi and cellular, does not start from the initial congestion
+ * window on each switch.
+ */
+static void conn_cc_resume_on_migration(ngtcp2_conn *conn) {
+  ngtcp2_cc_path_state *ent;
+  const ngtcp2_path *path = &conn->dcid.current.ps.path;
+  size_t i;
+
+  conn->cc_resume.phase = NGTCP2_CC_RESUME_PHASE_NONE;
+
+  if (!conn_cc_resume_supported(conn) ||
+      ngtcp2_path_eq(&conn->cc_resume.ps.path, path)) {
+    return;
+  }
+
+  if (conn->cstat.min_rtt != UINT64_MAX) {
+    i = conn_cc_resume_find_path(conn, &conn->cc_resume.ps.path);
+    if (i < conn->cc_resume.npaths) {
+      conn_cc_resume_remove_path(conn, i);
+    } else if (conn->cc_resume.npaths == NGTCP2_CC_RESUME_MAX_PATHS) {
+      conn_cc_resume_remove_path(conn, 0);
+    }
+
+    ent = &conn->cc_resume.paths[conn->cc_resume.npaths++];
+    ngtcp2_path_storage_init2(&ent->ps, &conn->cc_resume.ps.path);
+    ngtcp2_conn_get_cc_resume_params(conn, &ent->params);
+  }
+
+  ngtcp2_path_storage_init2(&conn->cc_resume.ps, path);
+
+  i = conn_cc_resume_find_path(conn, path);
+  if (i == conn->cc_resume.npaths) {
+    return;
+  }
+
+  conn->cc_resume.params = conn->cc_resume.paths[i].params;
+  conn->cc_resume.phase = NGTCP2_CC_RESUME_PHASE_RECONNAISSANCE;
+
+  ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_RCV,
+                  "cc resume path state restored min_rtt=%" PRIu64
+                  " cwnd=%" PRIu64,
+                  conn->cc_resume.params.min_rtt / NGTCP2_MILLISECONDS,
+                  conn->cc_resume.params.cwnd);
+}
+
+/*
+ * conn_save_path_rtt saves RTT measured on the current path to
+ * |dcid|, so that it is still available after the path stops being
+ * the current path.
+ */
+static void conn_save_path_rtt(ngtcp2_conn *conn, ngtcp2_dcid *dcid) {
+  const ngtcp2_conn_stat *cstat = &conn->cstat;
+
+  if (cstat->min_rtt == UINT64_MAX) {
+    return;
+  }
+
+  dcid->latest_rtt = cstat->latest_rtt;
+  dcid->min_rtt = cstat->min_rtt;
+  dcid->smoothed_rtt = cstat->smoothed_rtt;
+}
+
+/*
+ * conn_reset_congestion_state resets congestion state.  If the
+ * connection has migrated to conn->dcid.current, the state of the
+ * previous path is remembered, and the state of the new path is
+ * resumed if it has been used before.
+ */
+static void conn_reset_congestion_state(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
+  /* Retry does not change the path, but migration does. */
+  if (conn->flags & NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED) {
+    conn_cc_resume_on_migration(conn);
+  }
+
+  conn_reset_conn_stat_cc(conn, &conn->cstat);
+
+  conn->cc.reset(&conn->cc, &conn->cstat, ts);
+
+  if (conn->hs_pktns) {
+    ngtcp2_rtb_reset_cc_state(&conn->hs_pktns->rtb,
+                              conn->hs_pktns->tx.last_pkt_num + 1);
+  }
+  ngtcp2_rtb_reset_cc_state(&conn->pktns.rtb, conn->pktns.tx.last_pkt_num + 1);
+  ngtcp2_rst_init(&conn->rst);
+
+  conn->tx.pacing.next_ts = UINT64_MAX;
+  conn->tx.pacing.departure_ts = 0;
+}
+
+static int conn_recv_path_response(ngtcp2_conn *conn, ngtcp2_path_response *fr,
+                                   ngtcp2_tstamp ts) {
+  int rv;
+  ngtcp2_duration pto, timeout;
+  ngtcp2_pv *pv = conn->pv, *npv;
+  uint8_t ent_flags;
+
+  if (!pv) {
+    return 0;
+  }
+
+  rv = ngtcp2_pv_validate(pv, &ent_flags, fr->data, ts);
+  if (rv != 0) {
     assert(!ngtcp2_err_is_fatal(rv));
 
     return 0;
@@ -5919,6 +7720,8 @@ static int conn_recv_path_response(ngtcp2_conn *conn, ngtcp2_path_response *fr,
 
     if (ngtcp2_path_eq(&pv->dcid.ps.path, &conn->dcid.current.ps.path)) {
       conn->dcid.current.flags |= NGTCP2_DCID_FLAG_PATH_VALIDATED;
+      conn->dcid.current.validated_ts = ts;
+      ngtcp2_dcid_add_rtt_sample(&conn->dcid.current, pv->dcid.latest_rtt);
     }
 
     rv = conn_call_path_validation(conn, pv,
@@ -6012,15 +7815,40 @@ static int pktns_pkt_num_is_duplicate(ngtcp2_pktns *pktns, int64_t pkt_num) {
   return ngtcp2_gaptr_is_pushed(&pktns->rx.pngap, (uint64_t)pkt_num, 1);
 }
 
+/*
+ * pktns_pkt_num_is_reordered returns nonzero if ack-eliciting packet
+ * |pkt_num| is out of order by |reordering_thresh| packets or more.
+ * If |reordering_thresh| is 0, this function always returns 0.
+ */
+static int pktns_pkt_num_is_reordered(ngtcp2_pktns *pktns, int64_t pkt_num,
+                                      uint64_t reordering_thresh) {
+  int64_t expected = pktns->rx.max_ack_eliciting_pkt_num + 1;
+
+  if (reordering_thresh == 0 || pkt_num == expected) {
+    return 0;
+  }
+
+  if (pkt_num > expected) {
+    return (uint64_t)(pkt_num - expected) >= reordering_thresh;
+  }
+
+  return (uint64_t)(expected - 1 - pkt_num) + 1 >= reordering_thresh;
+}
+
 /*
  * pktns_commit_recv_pkt_num marks packet number |pkt_num| as
- * received.
+ * received.  If ack-eliciting packet is out of order by
+ * |reordering_thresh| packets or more, immediate acknowledgement is
+ * scheduled.
  */
 static int pktns_commit_recv_pkt_num(ngtcp2_pktns *pktns, int64_t pkt_num,
-                                     int ack_eliciting, ngtcp2_tstamp ts) {
+                                     int ack_eliciting,
+                                     uint64_t reordering_thresh,
+                                     ngtcp2_tstamp ts) {
   int rv;
 
-  if (ack_eliciting && pktns->rx.max_ack_eliciting_pkt_num + 1 != pkt_num) {
+  if (ack_eliciting &&
+      pktns_pkt_num_is_reordered(pktns, pkt_num, reordering_thresh)) {
     ngtcp2_acktr_immediate_ack(&pktns->acktr);
   }
   if (pktns->rx.max_pkt_num < pkt_num) {
@@ -6055,8 +7883,18 @@ static int verify_token(const ngtcp2_vec *token, const ngtcp2_pkt_hd *hd) {
   return NGTCP2_ERR_PROTO;
 }
 
-static void pktns_increase_ecn_counts(ngtcp2_pktns *pktns,
-                                      const ngtcp2_pkt_info *pi) {
+/*
+ * pktns_increase_ecn_counts increases the ECN counts of |pktns| by
+ * the marking of the received packet described by |pi|.  It returns
+ * nonzero if the marking calls for an immediate acknowledgement.  If
+ * |ce_on_change| is nonzero, that is only when CE marking starts or
+ * ends.  Otherwise, that is whenever CE marking is found.
+ */
+static int pktns_increase_ecn_counts(ngtcp2_pktns *pktns,
+                                     const ngtcp2_pkt_info *pi,
+                                     int ce_on_change) {
+  int ce = 0, last_ce;
+
   switch (pi->ecn & NGTCP2_ECN_MASK) {
   case NGTCP2_ECN_ECT_0:
     ++pktns->rx.ecn.ect0;
@@ -6066,8 +7904,18 @@ static void pktns_increase_ecn_counts(ngtcp2_pktns *pktns,
     break;
   case NGTCP2_ECN_CE:
     ++pktns->rx.ecn.ce;
+    ce = 1;
     break;
   }
+
+  last_ce = pktns->rx.ecn.last_ce;
+  pktns->rx.ecn.last_ce = ce;
+
+  if (!ce_on_change) {
+    return ce;
+  }
+
+  return ce != last_ce;
 }
 
 /*
@@ -6152,6 +8000,7 @@ conn_recv_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
   ngtcp2_frame *fr = &mfr.fr;
   int rv;
   int require_ack = 0;
+  int ecn_ack;
   size_t hdpktlen;
   const uint8_t *payload;
   size_t payloadlen;
@@ -6166,6 +8015,7 @@ conn_recv_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
   ngtcp2_strm *crypto;
   ngtcp2_crypto_level crypto_level;
   int invalid_reserved_bits = 0;
+  ngtcp2_perf_phase perf_phase;
 
   if (pktlen == 0) {
     return 0;
@@ -6204,7 +8054,7 @@ conn_recv_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
 
     ngtcp2_log_rx_pkt_hd(&conn->log, &hd);
 
-    if (conn->server) {
+    if (conn_is_server(conn)) {
       return NGTCP2_ERR_DISCARD_PKT;
     }
 
@@ -6214,13 +8064,13 @@ conn_recv_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
       return NGTCP2_ERR_DISCARD_PKT;
     }
 
-    if (!ngtcp2_cid_eq(&conn->oscid, &hd.dcid)) {
+    if (!ngtcp2_cid_eq_inline(&conn->oscid, &hd.dcid)) {
       ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_PKT,
                       "packet was ignored because of mismatched DCID");
       return NGTCP2_ERR_DISCARD_PKT;
     }
 
-    if (!ngtcp2_cid_eq(&conn->dcid.current.cid, &hd.scid)) {
+    if (!ngtcp2_cid_eq_inline(&conn->dcid.current.cid, &hd.scid)) {
       /* Just discard invalid Version Negotiation packet */
       ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_PKT,
                       "packet was ignored because of mismatched SCID");
@@ -6240,7 +8090,7 @@ conn_recv_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
 
     ngtcp2_log_rx_pkt_hd(&conn->log, &hd);
 
-    if (conn->server) {
+    if (conn_is_server(conn)) {
       return NGTCP2_ERR_DISCARD_PKT;
     }
 
@@ -6274,7 +8124,7 @@ conn_recv_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
     return NGTCP2_ERR_DISCARD_PKT;
   }
 
-  if (conn->server) {
+  if (conn_is_server(conn)) {
     if (hd.version != conn->client_chosen_version &&
         (!conn->negotiated_version || hd.version != conn->negotiated_version)) {
       return NGTCP2_ERR_DISCARD_PKT;
@@ -6288,7 +8138,7 @@ conn_recv_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
   /* Quoted from spec: if subsequent packets of those types include a
      different Source Connection ID, they MUST be discarded. */
   if ((conn->flags & NGTCP2_CONN_FLAG_CONN_ID_NEGOTIATED) &&
-      !ngtcp2_cid_eq(&conn->dcid.current.cid, &hd.scid)) {
+      !ngtcp2_cid_eq_inline(&conn->dcid.current.cid, &hd.scid)) {
     ngtcp2_log_rx_pkt_hd(&conn->log, &hd);
     ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_PKT,
                     "packet was ignored because of mismatched SCID");
@@ -6297,7 +8147,7 @@ conn_recv_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
 
   switch (hd.type) {
   case NGTCP2_PKT_0RTT:
-    if (!conn->server) {
+    if (!conn_is_server(conn)) {
       return NGTCP2_ERR_DISCARD_PKT;
     }
 
@@ -6342,7 +8192,7 @@ conn_recv_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
 
     assert(conn->in_pktns);
 
-    if (conn->server) {
+    if (conn_is_server(conn)) {
       if (dgramlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE) {
         ngtcp2_log_info(
             &conn->log, NGTCP2_LOG_EVENT_PKT,
@@ -6421,7 +8271,7 @@ conn_recv_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
     }
 
     if (!conn->hs_pktns->crypto.rx.ckm) {
-      if (conn->server) {
+      if (conn_is_server(conn)) {
         ngtcp2_log_info(
             &conn->log, NGTCP2_LOG_EVENT_PKT,
             "Handshake packet at this point is unexpected and discarded");
@@ -6467,8 +8317,11 @@ conn_recv_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
     return rv;
   }
 
+  perf_phase = ngtcp2_perf_switch(&conn->perf, NGTCP2_PERF_PHASE_DECRYPT);
   nwrite = decrypt_hp(&hd, conn->crypto.decrypt_hp_buf.base, hp, pkt, pktlen,
-                      (size_t)nread, hp_ctx, hp_mask);
+                      (size_t)nread, hp_ctx, hp_mask,
+                      /* precomputed_mask = */ NULL);
+  ngtcp2_perf_switch(&conn->perf, perf_phase);
   if (nwrite < 0) {
     if (ngtcp2_err_is_fatal((int)nwrite)) {
       return nwrite;
@@ -6513,13 +8366,18 @@ conn_recv_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
     return rv;
   }
 
+  perf_phase = ngtcp2_perf_switch(&conn->perf, NGTCP2_PERF_PHASE_DECRYPT);
   nwrite = decrypt_pkt(conn->crypto.decrypt_buf.base, aead, payload, payloadlen,
                        conn->crypto.decrypt_hp_buf.base, hdpktlen, hd.pkt_num,
                        ckm, decrypt);
+  ngtcp2_perf_switch(&conn->perf, perf_phase);
   if (nwrite < 0) {
     if (ngtcp2_err_is_fatal((int)nwrite)) {
       return nwrite;
     }
+
+    ++conn->cstat.decrypt_failure_count;
+
     ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_PKT,
                     "could not decrypt packet payload");
     return NGTCP2_ERR_DISCARD_PKT;
@@ -6529,7 +8387,7 @@ conn_recv_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
     return NGTCP2_ERR_PROTO;
   }
 
-  if (!conn->server && hd.version != conn->client_chosen_version &&
+  if (!conn_is_server(conn) && hd.version != conn->client_chosen_version &&
       !conn->negotiated_version) {
     conn->negotiated_version = hd.version;
 
@@ -6543,8 +8401,9 @@ conn_recv_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
 
   switch (hd.type) {
   case NGTCP2_PKT_INITIAL:
-    if (!conn->server || ((conn->flags & NGTCP2_CONN_FLAG_CONN_ID_NEGOTIATED) &&
-                          !ngtcp2_cid_eq(&conn->rcid, &hd.dcid))) {
+    if (!conn_is_server(conn) ||
+        ((conn->flags & NGTCP2_CONN_FLAG_CONN_ID_NEGOTIATED) &&
+         !ngtcp2_cid_eq_inline(&conn->rcid, &hd.dcid))) {
       rv = conn_verify_dcid(conn, NULL, &hd);
       if (rv != 0) {
         if (ngtcp2_err_is_fatal(rv)) {
@@ -6582,7 +8441,7 @@ conn_recv_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
   if (hd.type == NGTCP2_PKT_INITIAL &&
       !(conn->flags & NGTCP2_CONN_FLAG_CONN_ID_NEGOTIATED)) {
     conn->flags |= NGTCP2_CONN_FLAG_CONN_ID_NEGOTIATED;
-    if (!conn->server) {
+    if (!conn_is_server(conn)) {
       conn->dcid.current.cid = hd.scid;
     }
   }
@@ -6590,7 +8449,10 @@ conn_recv_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
   ngtcp2_qlog_pkt_received_start(&conn->qlog);
 
   for (; payloadlen;) {
+    perf_phase =
+        ngtcp2_perf_switch(&conn->perf, NGTCP2_PERF_PHASE_FRAME_DECODE);
     nread = ngtcp2_pkt_decode_frame(fr, payload, payloadlen);
+    ngtcp2_perf_switch(&conn->perf, perf_phase);
     if (nread < 0) {
       return nread;
     }
@@ -6611,10 +8473,12 @@ conn_recv_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
     switch (fr->type) {
     case NGTCP2_FRAME_ACK:
     case NGTCP2_FRAME_ACK_ECN:
-      if (!conn->server && hd.type == NGTCP2_PKT_HANDSHAKE) {
+      if (!conn_is_server(conn) && hd.type == NGTCP2_PKT_HANDSHAKE) {
         conn->flags |= NGTCP2_CONN_FLAG_SERVER_ADDR_VERIFIED;
       }
+      perf_phase = ngtcp2_perf_switch(&conn->perf, NGTCP2_PERF_PHASE_ACK);
       rv = conn_recv_ack(conn, pktns, &fr->ack, pkt_ts, ts);
+      ngtcp2_perf_switch(&conn->perf, perf_phase);
       if (rv != 0) {
         return rv;
       }
@@ -6622,7 +8486,7 @@ conn_recv_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
     case NGTCP2_FRAME_PADDING:
       break;
     case NGTCP2_FRAME_CRYPTO:
-      if (!conn->server && !conn->negotiated_version &&
+      if (!conn_is_server(conn) && !conn->negotiated_version &&
           ngtcp2_vec_len(fr->crypto.data, fr->crypto.datacnt)) {
         conn->negotiated_version = hd.version;
 
@@ -6653,26 +8517,32 @@ conn_recv_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
     ngtcp2_qlog_write_frame(&conn->qlog, fr);
   }
 
-  if (conn->server && hd.type == NGTCP2_PKT_HANDSHAKE) {
+  if (conn_is_server(conn) && hd.type == NGTCP2_PKT_HANDSHAKE) {
     /* Successful processing of Handshake packet from client verifies
        source address. */
-    conn->dcid.current.flags |= NGTCP2_DCID_FLAG_PATH_VALIDATED;
+    if (!(conn->dcid.current.flags & NGTCP2_DCID_FLAG_PATH_VALIDATED)) {
+      conn->dcid.current.flags |= NGTCP2_DCID_FLAG_PATH_VALIDATED;
+      conn->dcid.current.validated_ts = ts;
+      conn_amplification_unblocked(conn, ts);
+    }
   }
 
   ngtcp2_qlog_pkt_received_end(&conn->qlog, &hd, pktlen);
+  NGTCP2_PROBE4(pkt_recv, conn, hd.pkt_num, hd.type, pktlen);
 
-  rv = pktns_commit_recv_pkt_num(pktns, hd.pkt_num, require_ack, pkt_ts);
+  rv = pktns_commit_recv_pkt_num(pktns, hd.pkt_num, require_ack,
+                                 /* reordering_thresh = */ 1, pkt_ts);
   if (rv != 0) {
     return rv;
   }
 
-  pktns_increase_ecn_counts(pktns, pi);
+  ecn_ack = pktns_increase_ecn_counts(pktns, pi,
+                                      conn->local.settings.ack_ce_on_change);
 
   /* TODO Initial and Handshake are always acknowledged without
      delay. */
   if (require_ack &&
-      (++pktns->acktr.rx_npkt >= conn->local.settings.ack_thresh ||
-       (pi->ecn & NGTCP2_ECN_MASK) == NGTCP2_ECN_CE)) {
+      (++pktns->acktr.rx_npkt >= conn->local.settings.ack_thresh || ecn_ack)) {
     ngtcp2_acktr_immediate_ack(&pktns->acktr);
   }
 
@@ -6724,6 +8594,7 @@ static ngtcp2_ssize conn_recv_handshake_cpkt(ngtcp2_conn *conn,
 
   if (ngtcp2_path_eq(&conn->dcid.current.ps.path, path)) {
     conn->dcid.current.bytes_recv += dgramlen;
+    conn_amplification_unblocked(conn, ts);
   }
 
   while (pktlen) {
@@ -6742,7 +8613,7 @@ static ngtcp2_ssize conn_recv_handshake_cpkt(ngtcp2_conn *conn,
         /* Not a Version Negotiation packet */
         version = ngtcp2_get_uint32(&pkt[1]);
         if (ngtcp2_pkt_get_type_long(version, pkt[0]) == NGTCP2_PKT_INITIAL) {
-          if (conn->server) {
+          if (conn_is_server(conn)) {
             if (is_unrecoverable_error((int)nread)) {
               /* If server gets crypto error from TLS stack, it is
                  unrecoverable, therefore drop connection. */
@@ -6823,8 +8694,9 @@ int ngtcp2_conn_init_stream(ngtcp2_conn *conn, ngtcp2_strm *strm,
   }
 
   ngtcp2_strm_init(strm, stream_id, NGTCP2_STRM_FLAG_NONE, max_rx_offset,
-                   max_tx_offset, stream_user_data, &conn->frc_objalloc,
+                   max_tx_offset, stream_user_data, conn->frc_objalloc,
                    conn->mem);
+  strm->pool = &conn->strm_pool;
 
   rv = ngtcp2_map_insert(&conn->strms, (ngtcp2_map_key_type)strm->stream_id,
                          strm);
@@ -6833,6 +8705,8 @@ int ngtcp2_conn_init_stream(ngtcp2_conn *conn, ngtcp2_strm *strm,
     goto fail;
   }
 
+  NGTCP2_PROBE2(stream_open, conn, stream_id);
+
   return 0;
 
 fail:
@@ -6843,10 +8717,11 @@ fail:
 /*
  * conn_emit_pending_stream_data passes buffered ordered stream data
  * to the application.  |rx_offset| is the first offset to deliver to
- * the application.  This function assumes that the data up to
- * |rx_offset| has been delivered already.  This function only passes
- * the ordered data without any gap.  If there is a gap, it stops
- * providing the data to the application, and returns.
+ * the application.  |ts| is the current time.  This function assumes
+ * that the data up to |rx_offset| has been delivered already.  This
+ * function only passes the ordered data without any gap.  If there is
+ * a gap, it stops providing the data to the application, and
+ * returns.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -6857,13 +8732,14 @@ fail:
  *     Out of memory.
  */
 static int conn_emit_pending_stream_data(ngtcp2_conn *conn, ngtcp2_strm *strm,
-                                         uint64_t rx_offset) {
+                                         uint64_t rx_offset, ngtcp2_tstamp ts) {
   size_t datalen;
   const uint8_t *data;
   int rv;
   uint64_t offset;
   uint32_t sdflags;
   int handshake_completed = conn_is_handshake_completed(conn);
+  int emitted = 0;
 
   if (!strm->rx.rob) {
     return 0;
@@ -6880,6 +8756,25 @@ static int conn_emit_pending_stream_data(ngtcp2_conn *conn, ngtcp2_strm *strm,
     datalen = ngtcp2_rob_data_at(strm->rx.rob, &data, rx_offset);
     if (datalen == 0) {
       assert(rx_offset == ngtcp2_strm_rx_offset(strm));
+
+      if (emitted && conn->latency) {
+        /* The data behind the next gap, if any, start waiting for
+           it now. */
+        strm->rx.hol_ts = ngtcp2_ksl_len(&strm->rx.rob->gapksl) > 1
+                              ? ts
+                              : UINT64_MAX;
+      }
+
+      if (strm->rx.hol_start != UINT64_MAX &&
+          ngtcp2_ksl_len(&strm->rx.rob->gapksl) <= 1) {
+        if (strm->rx.hol_start < ts) {
+          strm->rx.hol.blocked_duration += ts - strm->rx.hol_start;
+          conn->hol.blocked_duration += ts - strm->rx.hol_start;
+        }
+
+        strm->rx.hol_start = UINT64_MAX;
+      }
+
       return 0;
     }
 
@@ -6894,13 +8789,31 @@ static int conn_emit_pending_stream_data(ngtcp2_conn *conn, ngtcp2_strm *strm,
     if (!handshake_completed) {
       sdflags |= NGTCP2_STREAM_DATA_FLAG_EARLY;
     }
+    if (conn->local.settings.loan_stream_data) {
+      sdflags |= NGTCP2_STREAM_DATA_FLAG_LOANED;
+    }
 
     rv = conn_call_recv_stream_data(conn, strm, sdflags, offset, data, datalen);
     if (rv != 0) {
       return rv;
     }
 
-    ngtcp2_rob_pop(strm->rx.rob, rx_offset - datalen, datalen);
+    if (conn->latency && strm->rx.hol_ts != UINT64_MAX &&
+        strm->rx.hol_ts <= ts) {
+      ngtcp2_latency_hist_add(&conn->latency->recv_to_app,
+                              ts - strm->rx.hol_ts);
+    }
+
+    emitted = 1;
+
+    strm->rx.hol.blocked_bytes += datalen;
+    conn->hol.blocked_bytes += datalen;
+
+    if (sdflags & NGTCP2_STREAM_DATA_FLAG_LOANED) {
+      ngtcp2_rob_loan(strm->rx.rob, rx_offset - datalen, datalen);
+    } else {
+      ngtcp2_rob_pop(strm->rx.rob, rx_offset - datalen, datalen);
+    }
   }
 }
 
@@ -6945,7 +8858,7 @@ static int conn_recv_crypto(ngtcp2_conn *conn, ngtcp2_crypto_level crypto_level,
   rx_offset = ngtcp2_strm_rx_offset(crypto);
 
   if (fr_end_offset <= rx_offset) {
-    if (conn->server &&
+    if (conn_is_server(conn) &&
         !(conn->flags & NGTCP2_CONN_FLAG_HANDSHAKE_EARLY_RETRANSMIT) &&
         crypto_level == NGTCP2_CRYPTO_LEVEL_INITIAL) {
       /* recovery draft: Speeding Up Handshake Completion
@@ -7015,6 +8928,8 @@ static int conn_max_data_violated(ngtcp2_conn *conn, uint64_t datalen) {
 
 /*
  * conn_recv_stream is called when STREAM frame |fr| is received.
+ * |pkt_ts| is the time when the packet carrying |fr| was received,
+ * and |ts| is the current time.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -7037,7 +8952,8 @@ static int conn_max_data_violated(ngtcp2_conn *conn, uint64_t datalen) {
  *     STREAM frame has strictly larger end offset than it is
  *     permitted.
  */
-static int conn_recv_stream(ngtcp2_conn *conn, const ngtcp2_stream *fr) {
+static int conn_recv_stream(ngtcp2_conn *conn, const ngtcp2_stream *fr,
+                            ngtcp2_tstamp pkt_ts, ngtcp2_tstamp ts) {
   int rv;
   ngtcp2_strm *strm;
   ngtcp2_idtr *idtr;
@@ -7095,14 +9011,14 @@ static int conn_recv_stream(ngtcp2_conn *conn, const ngtcp2_stream *fr) {
       return 0;
     }
 
-    strm = ngtcp2_objalloc_strm_get(&conn->strm_objalloc);
+    strm = ngtcp2_objalloc_strm_get(conn->strm_objalloc);
     if (strm == NULL) {
       return NGTCP2_ERR_NOMEM;
     }
     /* TODO Perhaps, call new_stream callback? */
     rv = ngtcp2_conn_init_stream(conn, strm, fr->stream_id, NULL);
     if (rv != 0) {
-      ngtcp2_objalloc_strm_release(&conn->strm_objalloc, strm);
+      ngtcp2_objalloc_strm_release(conn->strm_objalloc, strm);
       return rv;
     }
 
@@ -7166,6 +9082,8 @@ static int conn_recv_stream(ngtcp2_conn *conn, const ngtcp2_stream *fr) {
 
     strm->rx.last_offset = ngtcp2_max(strm->rx.last_offset, fr_end_offset);
 
+    conn_update_flow_update_urgency(conn, strm);
+
     if (fr_end_offset <= rx_offset) {
       return 0;
     }
@@ -7175,6 +9093,20 @@ static int conn_recv_stream(ngtcp2_conn *conn, const ngtcp2_stream *fr) {
     }
   }
 
+  if (fr->datacnt && conn_fec_max_symbollen(conn)) {
+    if (strm->rx.fec == NULL) {
+      rv = ngtcp2_fec_rxbuf_new(&strm->rx.fec,
+                                (size_t)conn->local.transport_params.fec_window,
+                                fr->offset, conn->mem);
+      if (rv != 0) {
+        return rv;
+      }
+    }
+
+    ngtcp2_fec_rxbuf_store(strm->rx.fec, fr->offset, fr->data[0].base,
+                           fr->data[0].len);
+  }
+
   if (fr->offset <= rx_offset) {
     size_t ncut = (size_t)(rx_offset - fr->offset);
     uint64_t offset = rx_offset;
@@ -7209,13 +9141,22 @@ static int conn_recv_stream(ngtcp2_conn *conn, const ngtcp2_stream *fr) {
       if (!conn_is_handshake_completed(conn)) {
         sdflags |= NGTCP2_STREAM_DATA_FLAG_EARLY;
       }
+      /* The buffered packets and the data recovered from REPAIR frame
+         live in the internal buffers. */
+      if (datalen && conn->rx.pkt_begin <= data && data < conn->rx.pkt_end) {
+        sdflags |= NGTCP2_STREAM_DATA_FLAG_IN_PLACE;
+      }
       rv = conn_call_recv_stream_data(conn, strm, sdflags, offset, data,
                                       (size_t)datalen);
       if (rv != 0) {
         return rv;
       }
 
-      rv = conn_emit_pending_stream_data(conn, strm, rx_offset);
+      if (conn->latency && datalen && pkt_ts <= ts) {
+        ngtcp2_latency_hist_add(&conn->latency->recv_to_app, ts - pkt_ts);
+      }
+
+      rv = conn_emit_pending_stream_data(conn, strm, rx_offset, ts);
       if (rv != 0) {
         return rv;
       }
@@ -7226,6 +9167,16 @@ static int conn_recv_stream(ngtcp2_conn *conn, const ngtcp2_stream *fr) {
     if (rv != 0) {
       return rv;
     }
+
+    if (conn->latency && strm->rx.hol_ts == UINT64_MAX) {
+      strm->rx.hol_ts = pkt_ts;
+    }
+
+    if (strm->rx.hol_start == UINT64_MAX) {
+      strm->rx.hol_start = ts;
+      ++strm->rx.hol.nblocked;
+      ++conn->hol.nblocked;
+    }
   }
   return ngtcp2_conn_close_stream_if_shut_rdwr(conn, strm);
 }
@@ -7246,7 +9197,7 @@ static int conn_reset_stream(ngtcp2_conn *conn, ngtcp2_strm *strm,
   ngtcp2_frame_chain *frc;
   ngtcp2_pktns *pktns = &conn->pktns;
 
-  rv = ngtcp2_frame_chain_objalloc_new(&frc, &conn->frc_objalloc);
+  rv = ngtcp2_frame_chain_objalloc_new(&frc, conn->frc_objalloc);
   if (rv != 0) {
     return rv;
   }
@@ -7279,7 +9230,7 @@ static int conn_stop_sending(ngtcp2_conn *conn, ngtcp2_strm *strm,
   ngtcp2_frame_chain *frc;
   ngtcp2_pktns *pktns = &conn->pktns;
 
-  rv = ngtcp2_frame_chain_objalloc_new(&frc, &conn->frc_objalloc);
+  rv = ngtcp2_frame_chain_objalloc_new(&frc, conn->frc_objalloc);
   if (rv != 0) {
     return rv;
   }
@@ -7526,13 +9477,13 @@ static int conn_recv_stop_sending(ngtcp2_conn *conn,
 
     /* Frame is received reset before we create ngtcp2_strm
        object. */
-    strm = ngtcp2_objalloc_strm_get(&conn->strm_objalloc);
+    strm = ngtcp2_objalloc_strm_get(conn->strm_objalloc);
     if (strm == NULL) {
       return NGTCP2_ERR_NOMEM;
     }
     rv = ngtcp2_conn_init_stream(conn, strm, fr->stream_id, NULL);
     if (rv != 0) {
-      ngtcp2_objalloc_strm_release(&conn->strm_objalloc, strm);
+      ngtcp2_objalloc_strm_release(conn->strm_objalloc, strm);
       return rv;
     }
 
@@ -7750,7 +9701,7 @@ static int conn_recv_new_connection_id(ngtcp2_conn *conn,
   if (rv != 0) {
     return rv;
   }
-  if (ngtcp2_cid_eq(&conn->dcid.current.cid, &fr->cid)) {
+  if (ngtcp2_cid_eq_inline(&conn->dcid.current.cid, &fr->cid)) {
     found = 1;
   }
 
@@ -7760,7 +9711,7 @@ static int conn_recv_new_connection_id(ngtcp2_conn *conn,
     if (rv != 0) {
       return rv;
     }
-    if (ngtcp2_cid_eq(&pv->dcid.cid, &fr->cid)) {
+    if (ngtcp2_cid_eq_inline(&pv->dcid.cid, &fr->cid)) {
       found = 1;
     }
   }
@@ -7774,7 +9725,7 @@ static int conn_recv_new_connection_id(ngtcp2_conn *conn,
     if (rv != 0) {
       return NGTCP2_ERR_PROTO;
     }
-    if (ngtcp2_cid_eq(&dcid->cid, &fr->cid)) {
+    if (ngtcp2_cid_eq_inline(&dcid->cid, &fr->cid)) {
       found = 1;
     }
   }
@@ -7788,7 +9739,7 @@ static int conn_recv_new_connection_id(ngtcp2_conn *conn,
     if (rv != 0) {
       return NGTCP2_ERR_PROTO;
     }
-    if (ngtcp2_cid_eq(&dcid->cid, &fr->cid)) {
+    if (ngtcp2_cid_eq_inline(&dcid->cid, &fr->cid)) {
       found = 1;
     }
   }
@@ -8003,7 +9954,7 @@ static int conn_recv_retire_connection_id(ngtcp2_conn *conn,
        ngtcp2_ksl_it_next(&it)) {
     scid = ngtcp2_ksl_it_get(&it);
     if (scid->seq == fr->seq) {
-      if (ngtcp2_cid_eq(&scid->cid, &hd->dcid)) {
+      if (ngtcp2_cid_eq_inline(&scid->cid, &hd->dcid)) {
         return NGTCP2_ERR_PROTO;
       }
 
@@ -8038,7 +9989,7 @@ static int conn_recv_retire_connection_id(ngtcp2_conn *conn,
  *     Server received NEW_TOKEN.
  */
 static int conn_recv_new_token(ngtcp2_conn *conn, const ngtcp2_new_token *fr) {
-  if (conn->server) {
+  if (conn_is_server(conn)) {
     return NGTCP2_ERR_PROTO;
   }
 
@@ -8049,6 +10000,28 @@ static int conn_recv_new_token(ngtcp2_conn *conn, const ngtcp2_new_token *fr) {
   return conn_call_recv_new_token(conn, &fr->token);
 }
 
+/*
+ * conn_grow_max_streams_window doubles |*pwindow| up to
+ * ngtcp2_settings.max_streams_window, and extends
+ * |*punsent_max_streams| by the amount that |*pwindow| grows.
+ */
+static void conn_grow_max_streams_window(ngtcp2_conn *conn,
+                                         uint64_t *punsent_max_streams,
+                                         uint64_t *pwindow) {
+  uint64_t max_window = conn->local.settings.max_streams_window;
+  uint64_t window;
+
+  if (*pwindow >= max_window) {
+    return;
+  }
+
+  window = ngtcp2_min(ngtcp2_max(*pwindow * 2, 1), max_window);
+
+  *punsent_max_streams = ngtcp2_min(
+      *punsent_max_streams + (window - *pwindow), (uint64_t)NGTCP2_MAX_STREAMS);
+  *pwindow = window;
+}
+
 /*
  * conn_recv_streams_blocked_bidi processes the incoming
  * STREAMS_BLOCKED (0x16).
@@ -8065,6 +10038,13 @@ static int conn_recv_streams_blocked_bidi(ngtcp2_conn *conn,
     return NGTCP2_ERR_FRAME_ENCODING;
   }
 
+  if (conn->local.settings.auto_max_streams &&
+      fr->max_streams == conn->remote.bidi.max_streams) {
+    conn_grow_max_streams_window(conn, &conn->remote.bidi.unsent_max_streams,
+                                 &conn->remote.bidi.window);
+    conn->remote.bidi.blocked = 1;
+  }
+
   return 0;
 }
 
@@ -8084,6 +10064,13 @@ static int conn_recv_streams_blocked_uni(ngtcp2_conn *conn,
     return NGTCP2_ERR_FRAME_ENCODING;
   }
 
+  if (conn->local.settings.auto_max_streams &&
+      fr->max_streams == conn->remote.uni.max_streams) {
+    conn_grow_max_streams_window(conn, &conn->remote.uni.unsent_max_streams,
+                                 &conn->remote.uni.window);
+    conn->remote.uni.blocked = 1;
+  }
+
   return 0;
 }
 
@@ -8163,7 +10150,7 @@ static int conn_select_preferred_addr(ngtcp2_conn *conn) {
 static int conn_recv_handshake_done(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
   int rv;
 
-  if (conn->server) {
+  if (conn_is_server(conn)) {
     return NGTCP2_ERR_PROTO;
   }
 
@@ -8214,6 +10201,145 @@ static int conn_recv_datagram(ngtcp2_conn *conn, ngtcp2_datagram *fr) {
   return conn_call_recv_datagram(conn, fr);
 }
 
+/*
+ * conn_recv_ack_frequency processes received ACK_FREQUENCY frame
+ * |fr|.  A frame which carries a sequence number smaller than the
+ * one already applied is ignored.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_PROTO
+ *     Local endpoint did not advertise min_ack_delay, or the
+ *     requested max_ack_delay is less than min_ack_delay.
+ */
+static int conn_recv_ack_frequency(ngtcp2_conn *conn,
+                                   const ngtcp2_ack_frequency *fr) {
+  ngtcp2_duration min_ack_delay = conn->local.transport_params.min_ack_delay;
+
+  if (min_ack_delay == 0 || fr->request_max_ack_delay >= (1 << 24) ||
+      fr->request_max_ack_delay * NGTCP2_MICROSECONDS < min_ack_delay) {
+    return NGTCP2_ERR_PROTO;
+  }
+
+  if (fr->seq < conn->rx.ack_freq.next_seq) {
+    return 0;
+  }
+
+  conn->rx.ack_freq.next_seq = fr->seq + 1;
+  conn->rx.ack_freq.ack_thresh =
+      ngtcp2_min(fr->ack_eliciting_threshold, NGTCP2_MAX_VARINT - 1) + 1;
+  conn->rx.ack_freq.max_ack_delay =
+      fr->request_max_ack_delay * NGTCP2_MICROSECONDS;
+  conn->rx.ack_freq.reordering_thresh = fr->reordering_threshold;
+
+  return 0;
+}
+
+/*
+ * conn_recv_immediate_ack processes received IMMEDIATE_ACK frame.
+ * It schedules an immediate acknowledgement in |pktns|.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_PROTO
+ *     Local endpoint did not advertise min_ack_delay.
+ */
+static int conn_recv_immediate_ack(ngtcp2_conn *conn, ngtcp2_pktns *pktns) {
+  if (conn->local.transport_params.min_ack_delay == 0) {
+    return NGTCP2_ERR_PROTO;
+  }
+
+  ngtcp2_acktr_immediate_ack(&pktns->acktr);
+
+  return 0;
+}
+
+/*
+ * conn_recv_repair processes received REPAIR frame |fr|.  If exactly
+ * one of the STREAM frames that |fr| protects has not been received,
+ * it is reconstructed from |fr| and the other STREAM frames, and
+ * processed as if it were received.  Otherwise, |fr| is ignored.
+ * |pkt_ts| and |ts| are passed to conn_recv_stream.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_PROTO
+ *     Local endpoint did not advertise fec_window.
+ *
+ * In addition to the above error codes, this function returns the
+ * error codes that conn_recv_stream returns.
+ */
+static int conn_recv_repair(ngtcp2_conn *conn, const ngtcp2_repair *fr,
+                            ngtcp2_tstamp pkt_ts, ngtcp2_tstamp ts) {
+  ngtcp2_strm *strm;
+  ngtcp2_stream sfr;
+  uint8_t buf[NGTCP2_MAX_FEC_SYMBOLLEN];
+  uint64_t offset, lost_offset = 0;
+  size_t i, lost = fr->symbolcnt;
+
+  if (conn->local.transport_params.fec_window == 0) {
+    return NGTCP2_ERR_PROTO;
+  }
+
+  strm = ngtcp2_conn_find_stream(conn, fr->stream_id);
+  if (strm == NULL || strm->rx.fec == NULL ||
+      (strm->flags & NGTCP2_STRM_FLAG_RECV_RST)) {
+    return 0;
+  }
+
+  for (i = 0, offset = fr->offset; i < fr->symbolcnt;
+       offset += fr->symbollen[i++]) {
+    if (!ngtcp2_strm_rx_data_received(strm, offset, fr->symbollen[i])) {
+      if (lost != fr->symbolcnt) {
+        return 0;
+      }
+
+      lost = i;
+      lost_offset = offset;
+
+      continue;
+    }
+
+    if (!ngtcp2_fec_rxbuf_retains(strm->rx.fec, offset, fr->symbollen[i])) {
+      return 0;
+    }
+  }
+
+  if (lost == fr->symbolcnt) {
+    return 0;
+  }
+
+  memcpy(buf, fr->data.base, fr->data.len);
+
+  for (i = 0, offset = fr->offset; i < fr->symbolcnt;
+       offset += fr->symbollen[i++]) {
+    if (i != lost) {
+      ngtcp2_fec_rxbuf_xor(strm->rx.fec, buf, offset, fr->symbollen[i]);
+    }
+  }
+
+  ++conn->cstat.fec_recovered_count;
+
+  ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_CON,
+                  "recovered stream_id=%" PRId64 " offset=%" PRIu64
+                  " len=%u from REPAIR",
+                  fr->stream_id, lost_offset, fr->symbollen[lost]);
+
+  sfr.type = NGTCP2_FRAME_STREAM;
+  sfr.flags = 0;
+  sfr.fin = 0;
+  sfr.stream_id = fr->stream_id;
+  sfr.offset = lost_offset;
+  sfr.datacnt = 1;
+  sfr.data[0].base = buf;
+  sfr.data[0].len = fr->symbollen[lost];
+
+  return conn_recv_stream(conn, &sfr, pkt_ts, ts);
+}
+
 /*
  * conn_key_phase_changed returns nonzero if |hd| indicates that the
  * key phase has unexpected value.
@@ -8226,30 +10352,77 @@ static int conn_key_phase_changed(ngtcp2_conn *conn, const ngtcp2_pkt_hd *hd) {
 }
 
 /*
- * conn_prepare_key_update installs new updated keys.
+ * conn_discard_old_rx_key deletes the decryption key of the previous
+ * key phase.
+ */
+static void conn_discard_old_rx_key(ngtcp2_conn *conn) {
+  conn_call_delete_crypto_aead_ctx(
+      conn, &conn->crypto.key_update.old_rx_ckm->aead_ctx);
+  ngtcp2_crypto_km_del(conn->crypto.key_update.old_rx_ckm, conn->mem);
+  conn->crypto.key_update.old_rx_ckm = NULL;
+}
+
+/*
+ * conn_key_update_threshold returns the number of packets encrypted
+ * with the current 1RTT key after which the library initiates key
+ * update.  It leaves at least 1/8 of the confidentiality limit to
+ * retry the key update if it cannot be initiated yet.
+ */
+static uint64_t conn_key_update_threshold(ngtcp2_conn *conn) {
+  uint64_t max_encryption = conn->pktns.crypto.ctx.max_encryption;
+
+  return max_encryption - max_encryption / 4 +
+         (max_encryption >> 11) * conn->crypto.key_update.jitter;
+}
+
+/*
+ * conn_prepare_key_update installs new updated keys.  Normally, the
+ * keys are derived 1 PTO after the current key update is confirmed,
+ * when the old decryption key is discarded.  If
+ * settings.eager_key_update is set, they are derived as soon as the
+ * key update is confirmed, and the old decryption key is kept until
+ * 1 PTO passes.
  */
 static int conn_prepare_key_update(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
   int rv;
   ngtcp2_tstamp confirmed_ts = conn->crypto.key_update.confirmed_ts;
   ngtcp2_duration pto = conn_compute_pto(conn, &conn->pktns);
   ngtcp2_pktns *pktns = &conn->pktns;
-  ngtcp2_crypto_km *rx_ckm = pktns->crypto.rx.ckm;
-  ngtcp2_crypto_km *tx_ckm = pktns->crypto.tx.ckm;
+  ngtcp2_crypto_km *rx_ckm, *tx_ckm;
   ngtcp2_crypto_km *new_rx_ckm, *new_tx_ckm;
   ngtcp2_crypto_aead_ctx rx_aead_ctx = {0}, tx_aead_ctx = {0};
   size_t secretlen, ivlen;
+  uint64_t use_count = pktns->crypto.tx.ckm->use_count;
 
   if ((conn->flags & NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED) &&
-      tx_ckm->use_count >= pktns->crypto.ctx.max_encryption &&
-      ngtcp2_conn_initiate_key_update(conn, ts) != 0) {
-    return NGTCP2_ERR_AEAD_LIMIT_REACHED;
+      use_count >= conn_key_update_threshold(conn)) {
+    /* Key update rotates, and frees the current tx key. */
+    rv = ngtcp2_conn_initiate_key_update(conn, ts);
+    if (rv == 0) {
+      ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_CRY,
+                      "key update initiated use_count=%" PRIu64, use_count);
+    } else if (use_count >= pktns->crypto.ctx.max_encryption) {
+      return NGTCP2_ERR_AEAD_LIMIT_REACHED;
+    } else if (ngtcp2_err_is_fatal(rv)) {
+      return rv;
+    }
   }
 
-  if ((conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_NOT_CONFIRMED) ||
-      (confirmed_ts != UINT64_MAX && confirmed_ts + pto > ts)) {
+  rx_ckm = pktns->crypto.rx.ckm;
+  tx_ckm = pktns->crypto.tx.ckm;
+
+  if (conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_NOT_CONFIRMED) {
     return 0;
   }
 
+  if (confirmed_ts != UINT64_MAX && confirmed_ts + pto > ts) {
+    if (!conn->local.settings.eager_key_update) {
+      return 0;
+    }
+  } else if (conn->crypto.key_update.old_rx_ckm) {
+    conn_discard_old_rx_key(conn);
+  }
+
   if (conn->crypto.key_update.new_rx_ckm ||
       conn->crypto.key_update.new_tx_ckm) {
     assert(conn->crypto.key_update.new_rx_ckm);
@@ -8291,14 +10464,8 @@ static int conn_prepare_key_update(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
     new_tx_ckm->flags |= NGTCP2_CRYPTO_KM_FLAG_KEY_PHASE_ONE;
   }
 
-  if (conn->crypto.key_update.old_rx_ckm) {
-    conn_call_delete_crypto_aead_ctx(
-        conn, &conn->crypto.key_update.old_rx_ckm->aead_ctx);
-    ngtcp2_crypto_km_del(conn->crypto.key_update.old_rx_ckm, conn->mem);
-    conn->crypto.key_update.old_rx_ckm = NULL;
-  }
-
-  return 0;
+  return conn_call_offload_tx_key(
+      conn, conn->crypto.key_update.tx_key_id + 1, new_tx_ckm);
 }
 
 /*
@@ -8310,11 +10477,20 @@ static void conn_rotate_keys(ngtcp2_conn *conn, int64_t pkt_num,
                              int initiator) {
   ngtcp2_pktns *pktns = &conn->pktns;
 
+  NGTCP2_PROBE3(key_update, conn, pkt_num, initiator);
+
   assert(conn->crypto.key_update.new_rx_ckm);
   assert(conn->crypto.key_update.new_tx_ckm);
-  assert(!conn->crypto.key_update.old_rx_ckm);
   assert(!(conn->flags & NGTCP2_CONN_FLAG_PPE_PENDING));
 
+  if (conn->crypto.key_update.old_rx_ckm) {
+    /* The keys were derived eagerly, and the next key phase started
+       before the old decryption key was discarded. */
+    assert(conn->local.settings.eager_key_update);
+
+    conn_discard_old_rx_key(conn);
+  }
+
   conn->crypto.key_update.old_rx_ckm = pktns->crypto.rx.ckm;
 
   pktns->crypto.rx.ckm = conn->crypto.key_update.new_rx_ckm;
@@ -8323,12 +10499,17 @@ static void conn_rotate_keys(ngtcp2_conn *conn, int64_t pkt_num,
 
   assert(pktns->crypto.tx.ckm);
 
-  conn_call_delete_crypto_aead_ctx(conn, &pktns->crypto.tx.ckm->aead_ctx);
-  ngtcp2_crypto_km_del(pktns->crypto.tx.ckm, conn->mem);
+  /* If an outstanding job still refers to the old key, the key is
+     deleted when the last such job is released. */
+  if (!conn_protect_jobs_refer(conn, pktns->crypto.tx.ckm)) {
+    conn_call_delete_crypto_aead_ctx(conn, &pktns->crypto.tx.ckm->aead_ctx);
+    ngtcp2_crypto_km_del(pktns->crypto.tx.ckm, conn->mem);
+  }
 
   pktns->crypto.tx.ckm = conn->crypto.key_update.new_tx_ckm;
   conn->crypto.key_update.new_tx_ckm = NULL;
   pktns->crypto.tx.ckm->pkt_num = pktns->tx.last_pkt_num + 1;
+  ++conn->crypto.key_update.tx_key_id;
 
   conn->flags |= NGTCP2_CONN_FLAG_KEY_UPDATE_NOT_CONFIRMED;
   if (initiator) {
@@ -8373,6 +10554,8 @@ static int conn_recv_non_probing_pkt_on_new_path(ngtcp2_conn *conn,
   int require_new_cid;
   int local_addr_eq;
   uint32_t remote_addr_cmp;
+  int reset_cc;
+  int fast_rebinding;
   size_t len, i;
 
   assert(conn->server);
@@ -8404,6 +10587,12 @@ static int conn_recv_non_probing_pkt_on_new_path(ngtcp2_conn *conn,
       ngtcp2_addr_compare(&conn->dcid.current.ps.path.remote, &path->remote);
   local_addr_eq =
       ngtcp2_addr_eq(&conn->dcid.current.ps.path.local, &path->local);
+  reset_cc = !local_addr_eq ||
+             (remote_addr_cmp & (NGTCP2_ADDR_COMPARE_FLAG_ADDR |
+                                 NGTCP2_ADDR_COMPARE_FLAG_FAMILY));
+  fast_rebinding =
+      !reset_cc && conn->local.settings.fast_nat_rebinding &&
+      (conn->dcid.current.flags & NGTCP2_DCID_FLAG_PATH_VALIDATED);
 
   /*
    * When to change DCID?  RFC 9002 section 9.5 says:
@@ -8481,12 +10670,22 @@ static int conn_recv_non_probing_pkt_on_new_path(ngtcp2_conn *conn,
       dcid.bytes_sent = 0;
       dcid.bytes_recv = 0;
       dcid.flags &= (uint8_t)~NGTCP2_DCID_FLAG_PATH_VALIDATED;
+      ngtcp2_dcid_reset_path_stat(&dcid);
     }
   }
 
   ngtcp2_dcid_set_path(&dcid, path);
   dcid.bytes_recv += dgramlen;
 
+  if (fast_rebinding) {
+    ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_PTV,
+                    "NAT rebinding; path is validated in background");
+
+    /* Path validation still runs, and falls back to the current path
+       if it fails. */
+    dcid.flags |= NGTCP2_DCID_FLAG_PATH_VALIDATED;
+  }
+
   rv = ngtcp2_pv_new(&pv, &dcid, timeout, NGTCP2_PV_FLAG_FALLBACK_ON_FAILURE,
                      &conn->log, conn->mem);
   if (rv != 0) {
@@ -8500,14 +10699,12 @@ static int conn_recv_non_probing_pkt_on_new_path(ngtcp2_conn *conn,
        DCID. */
     conn->pv->flags &= (uint8_t)~NGTCP2_PV_FLAG_FALLBACK_ON_FAILURE;
   } else {
+    conn_save_path_rtt(conn, &conn->dcid.current);
     ngtcp2_dcid_copy(&pv->fallback_dcid, &conn->dcid.current);
     pv->fallback_pto = pto;
   }
 
-  if (!local_addr_eq || (remote_addr_cmp & (NGTCP2_ADDR_COMPARE_FLAG_ADDR |
-                                            NGTCP2_ADDR_COMPARE_FLAG_FAMILY))) {
-    conn_reset_congestion_state(conn, ts);
-  } else {
+  if (!reset_cc) {
     /* For NAT rebinding, keep max_udp_payload_size since client most
        likely does not send a padded PATH_CHALLENGE. */
     dcid.max_udp_payload_size = ngtcp2_max(
@@ -8516,9 +10713,15 @@ static int conn_recv_non_probing_pkt_on_new_path(ngtcp2_conn *conn,
 
   ngtcp2_dcid_copy(&conn->dcid.current, &dcid);
 
-  conn_reset_ecn_validation_state(conn);
+  if (reset_cc) {
+    conn_reset_congestion_state(conn, ts);
+  }
 
-  ngtcp2_conn_stop_pmtud(conn);
+  if (!fast_rebinding) {
+    conn_reset_ecn_validation_state(conn);
+
+    ngtcp2_conn_stop_pmtud(conn);
+  }
 
   if (conn->pv) {
     ngtcp2_log_info(
@@ -8616,7 +10819,9 @@ conn_recv_delayed_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_pkt_info *pi,
   ngtcp2_frame *fr = &mfr.fr;
   int rv;
   int require_ack = 0;
+  int ecn_ack;
   ngtcp2_pktns *pktns;
+  ngtcp2_perf_phase perf_phase;
 
   assert(hd->type == NGTCP2_PKT_HANDSHAKE);
 
@@ -8630,7 +10835,10 @@ conn_recv_delayed_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_pkt_info *pi,
   ngtcp2_qlog_pkt_received_start(&conn->qlog);
 
   for (; payloadlen;) {
+    perf_phase =
+        ngtcp2_perf_switch(&conn->perf, NGTCP2_PERF_PHASE_FRAME_DECODE);
     nread = ngtcp2_pkt_decode_frame(fr, payload, payloadlen);
+    ngtcp2_perf_switch(&conn->perf, perf_phase);
     if (nread < 0) {
       return (int)nread;
     }
@@ -8651,10 +10859,12 @@ conn_recv_delayed_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_pkt_info *pi,
     switch (fr->type) {
     case NGTCP2_FRAME_ACK:
     case NGTCP2_FRAME_ACK_ECN:
-      if (!conn->server) {
+      if (!conn_is_server(conn)) {
         conn->flags |= NGTCP2_CONN_FLAG_SERVER_ADDR_VERIFIED;
       }
+      perf_phase = ngtcp2_perf_switch(&conn->perf, NGTCP2_PERF_PHASE_ACK);
       rv = conn_recv_ack(conn, pktns, &fr->ack, pkt_ts, ts);
+      ngtcp2_perf_switch(&conn->perf, perf_phase);
       if (rv != 0) {
         return rv;
       }
@@ -8679,17 +10889,19 @@ conn_recv_delayed_handshake_pkt(ngtcp2_conn *conn, const ngtcp2_pkt_info *pi,
   }
 
   ngtcp2_qlog_pkt_received_end(&conn->qlog, hd, pktlen);
+  NGTCP2_PROBE4(pkt_recv, conn, hd->pkt_num, hd->type, pktlen);
 
-  rv = pktns_commit_recv_pkt_num(pktns, hd->pkt_num, require_ack, pkt_ts);
+  rv = pktns_commit_recv_pkt_num(pktns, hd->pkt_num, require_ack,
+                                 /* reordering_thresh = */ 1, pkt_ts);
   if (rv != 0) {
     return rv;
   }
 
-  pktns_increase_ecn_counts(pktns, pi);
+  ecn_ack = pktns_increase_ecn_counts(pktns, pi,
+                                      conn->local.settings.ack_ce_on_change);
 
   if (require_ack &&
-      (++pktns->acktr.rx_npkt >= conn->local.settings.ack_thresh ||
-       (pi->ecn & NGTCP2_ECN_MASK) == NGTCP2_ECN_CE)) {
+      (++pktns->acktr.rx_npkt >= conn->local.settings.ack_thresh || ecn_ack)) {
     ngtcp2_acktr_immediate_ack(&pktns->acktr);
   }
 
@@ -8750,16 +10962,19 @@ static ngtcp2_ssize conn_recv_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
   int rv = 0;
   size_t hdpktlen;
   const uint8_t *payload;
+  uint8_t *plaintext;
   size_t payloadlen;
   ngtcp2_ssize nread, nwrite;
   ngtcp2_max_frame mfr;
   ngtcp2_frame *fr = &mfr.fr;
   int require_ack = 0;
+  int ecn_ack;
   ngtcp2_crypto_aead *aead;
   ngtcp2_crypto_cipher *hp;
   ngtcp2_crypto_km *ckm;
   ngtcp2_crypto_cipher_ctx *hp_ctx;
   ngtcp2_hp_mask hp_mask;
+  const uint8_t *precomputed_mask = NULL;
   ngtcp2_decrypt decrypt;
   ngtcp2_pktns *pktns;
   int non_probing_pkt = 0;
@@ -8768,6 +10983,7 @@ static ngtcp2_ssize conn_recv_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
   int recv_ncid = 0;
   int new_cid_used = 0;
   int path_challenge_recved = 0;
+  ngtcp2_perf_phase perf_phase;
 
   if (pkt[0] & NGTCP2_HEADER_FORM_BIT) {
     nread = ngtcp2_pkt_decode_hd_long(&hd, pkt, pktlen);
@@ -8792,7 +11008,7 @@ static ngtcp2_ssize conn_recv_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
 
     /* Quoted from spec: if subsequent packets of those types include
        a different Source Connection ID, they MUST be discarded. */
-    if (!ngtcp2_cid_eq(&conn->dcid.current.cid, &hd.scid)) {
+    if (!ngtcp2_cid_eq_inline(&conn->dcid.current.cid, &hd.scid)) {
       ngtcp2_log_rx_pkt_hd(&conn->log, &hd);
       ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_PKT,
                       "packet was ignored because of mismatched SCID");
@@ -8824,7 +11040,7 @@ static ngtcp2_ssize conn_recv_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
       decrypt = conn->callbacks.decrypt;
       break;
     case NGTCP2_PKT_0RTT:
-      if (!conn->server || hd.version != conn->client_chosen_version) {
+      if (!conn_is_server(conn) || hd.version != conn->client_chosen_version) {
         return NGTCP2_ERR_DISCARD_PKT;
       }
 
@@ -8861,6 +11077,7 @@ static ngtcp2_ssize conn_recv_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
     hp_ctx = &pktns->crypto.rx.hp_ctx;
     hp_mask = conn->callbacks.hp_mask;
     decrypt = conn->callbacks.decrypt;
+    precomputed_mask = conn_find_rx_hp_mask(conn, pkt);
   }
 
   rv = conn_ensure_decrypt_hp_buffer(conn, (size_t)nread + 4);
@@ -8868,8 +11085,10 @@ static ngtcp2_ssize conn_recv_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
     return rv;
   }
 
+  perf_phase = ngtcp2_perf_switch(&conn->perf, NGTCP2_PERF_PHASE_DECRYPT);
   nwrite = decrypt_hp(&hd, conn->crypto.decrypt_hp_buf.base, hp, pkt, pktlen,
-                      (size_t)nread, hp_ctx, hp_mask);
+                      (size_t)nread, hp_ctx, hp_mask, precomputed_mask);
+  ngtcp2_perf_switch(&conn->perf, perf_phase);
   if (nwrite < 0) {
     if (ngtcp2_err_is_fatal((int)nwrite)) {
       return nwrite;
@@ -8897,10 +11116,17 @@ static ngtcp2_ssize conn_recv_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
     key_phase_bit_changed = conn_key_phase_changed(conn, &hd);
   }
 
-  rv = conn_ensure_decrypt_buffer(conn, payloadlen);
-  if (rv != 0) {
-    return rv;
-  }
+  if (conn->local.settings.decrypt_in_place) {
+    /* The application guarantees that the buffer is writable. */
+    plaintext = (uint8_t *)payload;
+  } else {
+    rv = conn_ensure_decrypt_buffer(conn, payloadlen);
+    if (rv != 0) {
+      return rv;
+    }
+
+    plaintext = conn->crypto.decrypt_buf.base;
+  }
 
   if (key_phase_bit_changed) {
     assert(hd.type == NGTCP2_PKT_1RTT);
@@ -8931,9 +11157,11 @@ static ngtcp2_ssize conn_recv_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
     }
   }
 
-  nwrite = decrypt_pkt(conn->crypto.decrypt_buf.base, aead, payload, payloadlen,
+  perf_phase = ngtcp2_perf_switch(&conn->perf, NGTCP2_PERF_PHASE_DECRYPT);
+  nwrite = decrypt_pkt(plaintext, aead, payload, payloadlen,
                        conn->crypto.decrypt_hp_buf.base, hdpktlen, hd.pkt_num,
                        ckm, decrypt);
+  ngtcp2_perf_switch(&conn->perf, perf_phase);
 
   if (force_decrypt_failure) {
     nwrite = NGTCP2_ERR_DECRYPT;
@@ -8946,6 +11174,8 @@ static ngtcp2_ssize conn_recv_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
 
     assert(NGTCP2_ERR_DECRYPT == nwrite);
 
+    ++conn->cstat.decrypt_failure_count;
+
     if (hd.type == NGTCP2_PKT_1RTT &&
         ++conn->crypto.decryption_failure_count >=
             pktns->crypto.ctx.max_decryption_failure) {
@@ -8977,7 +11207,7 @@ static ngtcp2_ssize conn_recv_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
     return NGTCP2_ERR_DISCARD_PKT;
   }
 
-  payload = conn->crypto.decrypt_buf.base;
+  payload = plaintext;
   payloadlen = (size_t)nwrite;
 
   if (payloadlen == 0) {
@@ -9006,7 +11236,7 @@ static ngtcp2_ssize conn_recv_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
 
       return (ngtcp2_ssize)pktlen;
     case NGTCP2_PKT_0RTT:
-      if (!ngtcp2_cid_eq(&conn->rcid, &hd.dcid)) {
+      if (!ngtcp2_cid_eq_inline(&conn->rcid, &hd.dcid)) {
         rv = conn_verify_dcid(conn, NULL, &hd);
         if (rv != 0) {
           if (ngtcp2_err_is_fatal(rv)) {
@@ -9037,7 +11267,10 @@ static ngtcp2_ssize conn_recv_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
   ngtcp2_qlog_pkt_received_start(&conn->qlog);
 
   for (; payloadlen;) {
+    perf_phase =
+        ngtcp2_perf_switch(&conn->perf, NGTCP2_PERF_PHASE_FRAME_DECODE);
     nread = ngtcp2_pkt_decode_frame(fr, payload, payloadlen);
+    ngtcp2_perf_switch(&conn->perf, perf_phase);
     if (nread < 0) {
       return nread;
     }
@@ -9101,17 +11334,19 @@ static ngtcp2_ssize conn_recv_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
     switch (fr->type) {
     case NGTCP2_FRAME_ACK:
     case NGTCP2_FRAME_ACK_ECN:
-      if (!conn->server) {
+      if (!conn_is_server(conn)) {
         conn->flags |= NGTCP2_CONN_FLAG_SERVER_ADDR_VERIFIED;
       }
+      perf_phase = ngtcp2_perf_switch(&conn->perf, NGTCP2_PERF_PHASE_ACK);
       rv = conn_recv_ack(conn, pktns, &fr->ack, pkt_ts, ts);
+      ngtcp2_perf_switch(&conn->perf, perf_phase);
       if (rv != 0) {
         return rv;
       }
       non_probing_pkt = 1;
       break;
     case NGTCP2_FRAME_STREAM:
-      rv = conn_recv_stream(conn, &fr->stream);
+      rv = conn_recv_stream(conn, &fr->stream, pkt_ts, ts);
       if (rv != 0) {
         return rv;
       }
@@ -9237,12 +11472,33 @@ static ngtcp2_ssize conn_recv_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
       }
       non_probing_pkt = 1;
       break;
+    case NGTCP2_FRAME_ACK_FREQUENCY:
+      rv = conn_recv_ack_frequency(conn, &fr->ack_frequency);
+      if (rv != 0) {
+        return rv;
+      }
+      non_probing_pkt = 1;
+      break;
+    case NGTCP2_FRAME_IMMEDIATE_ACK:
+      rv = conn_recv_immediate_ack(conn, pktns);
+      if (rv != 0) {
+        return rv;
+      }
+      non_probing_pkt = 1;
+      break;    case NGTCP2_FRAME_REPAIR:
+      rv = conn_recv_repair(conn, &fr->repair, pkt_ts, ts);
+      if (rv != 0) {
+        return rv;
+      }
+      non_probing_pkt = 1;
+      break;
     }
 
     ngtcp2_qlog_write_frame(&conn->qlog, fr);
   }
 
   ngtcp2_qlog_pkt_received_end(&conn->qlog, &hd, pktlen);
+  NGTCP2_PROBE4(pkt_recv, conn, hd.pkt_num, hd.type, pktlen);
 
   if (recv_ncid) {
     rv = conn_post_process_recv_new_connection_id(conn, ts);
@@ -9251,7 +11507,7 @@ static ngtcp2_ssize conn_recv_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
     }
   }
 
-  if (conn->server && hd.type == NGTCP2_PKT_1RTT &&
+  if (conn_is_server(conn) && hd.type == NGTCP2_PKT_1RTT &&
       !ngtcp2_path_eq(&conn->dcid.current.ps.path, path)) {
     if (non_probing_pkt && pktns->rx.max_pkt_num < hd.pkt_num &&
         !conn_path_validation_in_progress(conn, path)) {
@@ -9287,7 +11543,7 @@ static ngtcp2_ssize conn_recv_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
       ckm->pkt_num = hd.pkt_num;
     }
 
-    if (conn->server && conn->early.ckm &&
+    if (conn_is_server(conn) && conn->early.ckm &&
         conn->early.discard_started_ts == UINT64_MAX) {
       conn->early.discard_started_ts = ts;
     }
@@ -9297,16 +11553,21 @@ static ngtcp2_ssize conn_recv_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
     }
   }
 
-  rv = pktns_commit_recv_pkt_num(pktns, hd.pkt_num, require_ack, pkt_ts);
+  if (hd.type == NGTCP2_PKT_1RTT && hd.pkt_num > pktns->rx.max_pkt_num) {
+    conn_update_spin_bit(conn, &hd);
+  }
+
+  rv = pktns_commit_recv_pkt_num(pktns, hd.pkt_num, require_ack,
+                                 conn->rx.ack_freq.reordering_thresh, pkt_ts);
   if (rv != 0) {
     return rv;
   }
 
-  pktns_increase_ecn_counts(pktns, pi);
+  ecn_ack = pktns_increase_ecn_counts(pktns, pi,
+                                      conn->local.settings.ack_ce_on_change);
 
   if (require_ack &&
-      (++pktns->acktr.rx_npkt >= conn->local.settings.ack_thresh ||
-       (pi->ecn & NGTCP2_ECN_MASK) == NGTCP2_ECN_CE)) {
+      (++pktns->acktr.rx_npkt >= conn->rx.ack_freq.ack_thresh || ecn_ack)) {
     ngtcp2_acktr_immediate_ack(&pktns->acktr);
   }
 
@@ -9334,40 +11595,43 @@ static ngtcp2_ssize conn_recv_pkt(ngtcp2_conn *conn, const ngtcp2_path *path,
 static int conn_process_buffered_protected_pkt(ngtcp2_conn *conn,
                                                ngtcp2_pktns *pktns,
                                                ngtcp2_tstamp ts) {
-  ngtcp2_ssize nread;
-  ngtcp2_pkt_chain **ppc, *next;
+  ngtcp2_ssize nread = 0;
+  ngtcp2_pkt_chain *pc;
   int rv;
 
   ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_CON,
                   "processing buffered protected packet");
 
-  for (ppc = &pktns->rx.buffed_pkts; *ppc;) {
-    next = (*ppc)->next;
-    nread = conn_recv_pkt(conn, &(*ppc)->path.path, &(*ppc)->pi, (*ppc)->pkt,
-                          (*ppc)->pktlen, (*ppc)->dgramlen, (*ppc)->ts, ts);
+  for (; pktns->rx.buffed_pkts;) {
+    pc = pktns->rx.buffed_pkts;
+    nread = conn_recv_pkt(conn, &pc->path.path, &pc->pi, pc->pkt, pc->pktlen,
+                          pc->dgramlen, pc->ts, ts);
+    pktns->rx.buffed_pkts = pc->next;
+
     if (nread < 0 && !ngtcp2_err_is_fatal((int)nread) &&
         nread != NGTCP2_ERR_DRAINING) {
       /* TODO We don't know this is the first QUIC packet in a
          datagram. */
-      rv = conn_on_stateless_reset(conn, &(*ppc)->path.path, (*ppc)->pkt,
-                                   (*ppc)->pktlen);
+      rv = conn_on_stateless_reset(conn, &pc->path.path, pc->pkt, pc->pktlen);
       if (rv == 0) {
-        ngtcp2_pkt_chain_del(*ppc, conn->mem);
-        *ppc = next;
-        return NGTCP2_ERR_DRAINING;
+        nread = NGTCP2_ERR_DRAINING;
+        break;
       }
     }
 
-    ngtcp2_pkt_chain_del(*ppc, conn->mem);
-    *ppc = next;
-    if (nread < 0) {
-      if (nread == NGTCP2_ERR_DISCARD_PKT) {
-        continue;
-      }
-      return (int)nread;
+    if (nread < 0 && nread != NGTCP2_ERR_DISCARD_PKT) {
+      break;
     }
   }
 
+  if (pktns->rx.buffed_pkts == NULL) {
+    delete_buffed_pkts(pktns, conn->mem);
+  }
+
+  if (nread < 0 && nread != NGTCP2_ERR_DISCARD_PKT) {
+    return (int)nread;
+  }
+
   return 0;
 }
 
@@ -9381,30 +11645,100 @@ static int conn_process_buffered_protected_pkt(ngtcp2_conn *conn,
 static int conn_process_buffered_handshake_pkt(ngtcp2_conn *conn,
                                                ngtcp2_tstamp ts) {
   ngtcp2_pktns *pktns = conn->hs_pktns;
-  ngtcp2_ssize nread;
-  ngtcp2_pkt_chain **ppc, *next;
+  ngtcp2_ssize nread = 0;
+  ngtcp2_pkt_chain *pc;
 
   ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_CON,
                   "processing buffered handshake packet");
 
-  for (ppc = &pktns->rx.buffed_pkts; *ppc;) {
-    next = (*ppc)->next;
-    nread = conn_recv_handshake_pkt(conn, &(*ppc)->path.path, &(*ppc)->pi,
-                                    (*ppc)->pkt, (*ppc)->pktlen,
-                                    (*ppc)->dgramlen, (*ppc)->ts, ts);
-    ngtcp2_pkt_chain_del(*ppc, conn->mem);
-    *ppc = next;
-    if (nread < 0) {
-      if (nread == NGTCP2_ERR_DISCARD_PKT) {
-        continue;
-      }
-      return (int)nread;
+  for (; pktns->rx.buffed_pkts;) {
+    pc = pktns->rx.buffed_pkts;
+    nread = conn_recv_handshake_pkt(conn, &pc->path.path, &pc->pi, pc->pkt,
+                                    pc->pktlen, pc->dgramlen, pc->ts, ts);
+    pktns->rx.buffed_pkts = pc->next;
+
+    if (nread < 0 && nread != NGTCP2_ERR_DISCARD_PKT) {
+      break;
     }
   }
 
+  if (pktns->rx.buffed_pkts == NULL) {
+    delete_buffed_pkts(pktns, conn->mem);
+  }
+
+  if (nread < 0 && nread != NGTCP2_ERR_DISCARD_PKT) {
+    return (int)nread;
+  }
+
+  return 0;
+}
+
+/*
+ * conn_vacant_remote_transport_params_storage returns the storage of
+ * the remote transport parameters which neither
+ * conn->remote.transport_params nor
+ * conn->remote.pending_transport_params points to.
+ */
+static ngtcp2_transport_params_storage *
+conn_vacant_remote_transport_params_storage(ngtcp2_conn *conn) {
+  ngtcp2_transport_params_storage *st = conn->remote.transport_params_storage;
+
+  if (&st->params == conn->remote.transport_params ||
+      &st->params == conn->remote.pending_transport_params) {
+    ++st;
+  }
+
+  assert(&st->params != conn->remote.transport_params);
+  assert(&st->params != conn->remote.pending_transport_params);
+
+  return st;
+}
+
+/*
+ * conn_copy_remote_transport_params copies |src| to the vacant
+ * storage of the remote transport parameters, and assigns the pointer
+ * to the copy to |*pparams|.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ */
+static int
+conn_copy_remote_transport_params(ngtcp2_conn *conn,
+                                  ngtcp2_transport_params **pparams,
+                                  const ngtcp2_transport_params *src) {
+  ngtcp2_transport_params_storage *st =
+      conn_vacant_remote_transport_params_storage(conn);
+  int rv;
+
+  rv = ngtcp2_transport_params_storage_copy(st, src, conn->mem);
+  if (rv != 0) {
+    return rv;
+  }
+
+  *pparams = &st->params;
+
   return 0;
 }
 
+/*
+ * conn_del_remote_transport_params frees |params| which points to one
+ * of conn->remote.transport_params_storage.  If |params| is NULL,
+ * this function does nothing.
+ */
+static void conn_del_remote_transport_params(ngtcp2_conn *conn,
+                                             ngtcp2_transport_params *params) {
+  if (!params) {
+    return;
+  }
+
+  ngtcp2_transport_params_storage_free(
+      ngtcp2_struct_of(params, ngtcp2_transport_params_storage, params),
+      conn->mem);
+}
+
 static void conn_sync_stream_id_limit(ngtcp2_conn *conn) {
   ngtcp2_transport_params *params = conn->remote.transport_params;
 
@@ -9512,6 +11846,7 @@ static int conn_recv_cpkt(ngtcp2_conn *conn, const ngtcp2_path *path,
 
   if (ngtcp2_path_eq(&conn->dcid.current.ps.path, path)) {
     conn->dcid.current.bytes_recv += dgramlen;
+    conn_amplification_unblocked(conn, ts);
   }
 
   while (pktlen) {
@@ -9577,7 +11912,7 @@ static int conn_enqueue_handshake_done(ngtcp2_conn *conn) {
 
   assert(conn->server);
 
-  rv = ngtcp2_frame_chain_objalloc_new(&nfrc, &conn->frc_objalloc);
+  rv = ngtcp2_frame_chain_objalloc_new(&nfrc, conn->frc_objalloc);
   if (rv != 0) {
     return rv;
   }
@@ -9589,6 +11924,80 @@ static int conn_enqueue_handshake_done(ngtcp2_conn *conn) {
   return 0;
 }
 
+/*
+ * conn_enqueue_ack_frequency enqueues ACK_FREQUENCY frame if the
+ * remote endpoint supports it and the desired acknowledgement
+ * frequency has changed since the last frame.  The frequency is
+ * derived from the current congestion window and smoothed RTT, and
+ * it is re-evaluated at most once per smoothed RTT.
+ */
+static int conn_enqueue_ack_frequency(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
+  const ngtcp2_transport_params *params = conn->remote.transport_params;
+  ngtcp2_conn_stat *cstat = &conn->cstat;
+  ngtcp2_pktns *pktns = &conn->pktns;
+  ngtcp2_frame_chain *nfrc;
+  uint64_t ack_eliciting_threshold;
+  ngtcp2_duration max_ack_delay;
+  int rv;
+
+  if (!params || params->min_ack_delay == 0) {
+    return 0;
+  }
+
+  if (conn->tx.ack_freq.last_ts != UINT64_MAX &&
+      conn->tx.ack_freq.last_ts + cstat->smoothed_rtt > ts) {
+    return 0;
+  }
+
+  ack_eliciting_threshold = cstat->cwnd / 4 / cstat->max_udp_payload_size;
+  if (ack_eliciting_threshold) {
+    --ack_eliciting_threshold;
+  }
+  ack_eliciting_threshold =
+      ngtcp2_min(ack_eliciting_threshold, NGTCP2_MAX_ACK_ELICITING_THRESHOLD);
+
+  max_ack_delay = ngtcp2_min(cstat->smoothed_rtt / 4, params->max_ack_delay);
+  max_ack_delay = ngtcp2_max(max_ack_delay, params->min_ack_delay);
+  max_ack_delay = max_ack_delay / NGTCP2_MICROSECONDS * NGTCP2_MICROSECONDS;
+
+  if (conn->tx.ack_freq.seq == 0) {
+    /* The remote endpoint acknowledges every other packet by
+       default.  Do not bother to send ACK_FREQUENCY until the
+       congestion window grows. */
+    if (ack_eliciting_threshold <= 1) {
+      return 0;
+    }
+  } else if (conn->tx.ack_freq.ack_eliciting_threshold ==
+                 ack_eliciting_threshold &&
+             conn->tx.ack_freq.max_ack_delay == max_ack_delay) {
+    conn->tx.ack_freq.last_ts = ts;
+
+    return 0;
+  }
+
+  rv = ngtcp2_frame_chain_objalloc_new(&nfrc, conn->frc_objalloc);
+  if (rv != 0) {
+    return rv;
+  }
+
+  nfrc->fr.ack_frequency.type = NGTCP2_FRAME_ACK_FREQUENCY;
+  nfrc->fr.ack_frequency.seq = conn->tx.ack_freq.seq++;
+  nfrc->fr.ack_frequency.ack_eliciting_threshold = ack_eliciting_threshold;
+  nfrc->fr.ack_frequency.request_max_ack_delay =
+      max_ack_delay / NGTCP2_MICROSECONDS;
+  /* Tolerate the same amount of reordering that loss detection
+     does. */
+  nfrc->fr.ack_frequency.reordering_threshold = NGTCP2_PKT_THRESHOLD;
+  nfrc->next = pktns->tx.frq;
+  pktns->tx.frq = nfrc;
+
+  conn->tx.ack_freq.ack_eliciting_threshold = ack_eliciting_threshold;
+  conn->tx.ack_freq.max_ack_delay = max_ack_delay;
+  conn->tx.ack_freq.last_ts = ts;
+
+  return 0;
+}
+
 /**
  * @function
  *
@@ -9804,37 +12213,24 @@ static ngtcp2_ssize conn_read_handshake(ngtcp2_conn *conn,
   }
 }
 
-int ngtcp2_conn_read_pkt_versioned(ngtcp2_conn *conn, const ngtcp2_path *path,
-                                   int pkt_info_version,
-                                   const ngtcp2_pkt_info *pi,
-                                   const uint8_t *pkt, size_t pktlen,
-                                   ngtcp2_tstamp ts) {
+/*
+ * conn_read_dgram processes a single UDP datagram |pkt| of length
+ * |pktlen|.  |pi| must not be NULL.
+ */
+static int conn_read_dgram(ngtcp2_conn *conn, const ngtcp2_path *path,
+                           const ngtcp2_pkt_info *pi, const uint8_t *pkt,
+                           size_t pktlen, ngtcp2_tstamp ts) {
   int rv = 0;
   ngtcp2_ssize nread = 0;
-  const ngtcp2_pkt_info zero_pi = {0};
-  (void)pkt_info_version;
-
-  conn->log.last_ts = ts;
-  conn->qlog.last_ts = ts;
 
   ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_CON, "recv packet len=%zu",
                   pktlen);
 
-  if (pktlen == 0) {
-    return NGTCP2_ERR_INVALID_ARGUMENT;
-  }
-
-  /* client does not expect a packet from unknown path. */
-  if (!conn->server && !ngtcp2_path_eq(&conn->dcid.current.ps.path, path) &&
-      (!conn->pv || !ngtcp2_path_eq(&conn->pv->dcid.ps.path, path)) &&
-      !conn_is_retired_path(conn, path)) {
-    ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_CON,
-                    "ignore packet from unknown path");
-    return 0;
-  }
-
-  if (!pi) {
-    pi = &zero_pi;
+  /* Incoming packet might rotate keys.  Protect pending packets with
+     the current key first. */
+  rv = conn_protect_pkts(conn);
+  if (rv != 0) {
+    return rv;
   }
 
   switch (conn->state) {
@@ -9906,6 +12302,110 @@ int ngtcp2_conn_read_pkt_versioned(ngtcp2_conn *conn, const ngtcp2_path *path,
   return conn_recv_cpkt(conn, path, pi, pkt, pktlen, ts);
 }
 
+/*
+ * conn_read_pkts processes UDP datagrams in |pkt| of length |pktlen|.
+ * The buffer contains datagrams of |segsize| bytes each, except for
+ * the last one which may be shorter.  The per-call bookkeeping, such
+ * as path check and timestamp update, is done once for all
+ * datagrams.  It stops at the first datagram which fails.
+ */
+static int conn_read_pkts(ngtcp2_conn *conn, const ngtcp2_path *path,
+                          int pkt_info_version, const ngtcp2_pkt_info *pi,
+                          const uint8_t *pkt, size_t pktlen, size_t segsize,
+                          ngtcp2_tstamp ts) {
+  int rv;
+  size_t n;
+  const ngtcp2_pkt_info zero_pi = {0};
+  (void)pkt_info_version;
+
+  conn->log.last_ts = ts;
+  conn->qlog.last_ts = ts;
+
+  if (pktlen == 0 || segsize == 0) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  /* client does not expect a packet from unknown path. */
+  if (!conn_is_server(conn) &&
+      !ngtcp2_path_eq(&conn->dcid.current.ps.path, path) &&
+      (!conn->pv || !ngtcp2_path_eq(&conn->pv->dcid.ps.path, path)) &&
+      !conn_is_retired_path(conn, path)) {
+    ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_CON,
+                    "ignore packet from unknown path");
+    return 0;
+  }
+
+  if (!pi) {
+    pi = &zero_pi;
+  }
+
+  for (; pktlen; pkt += n, pktlen -= n) {
+    n = ngtcp2_min(segsize, pktlen);
+
+    rv = conn_read_dgram(conn, path, pi, pkt, n, ts);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  return 0;
+}
+
+int ngtcp2_conn_read_pkt_versioned(ngtcp2_conn *conn, const ngtcp2_path *path,
+                                   int pkt_info_version,
+                                   const ngtcp2_pkt_info *pi,
+                                   const uint8_t *pkt, size_t pktlen,
+                                   ngtcp2_tstamp ts) {
+  return ngtcp2_conn_read_pkts_versioned(conn, path, pkt_info_version, pi, pkt,
+                                         pktlen, pktlen, ts);
+}
+
+int ngtcp2_conn_read_pkts_versioned(ngtcp2_conn *conn, const ngtcp2_path *path,
+                                    int pkt_info_version,
+                                    const ngtcp2_pkt_info *pi,
+                                    const uint8_t *pkt, size_t pktlen,
+                                    size_t segsize, ngtcp2_tstamp ts) {
+  int rv;
+  ngtcp2_perf_phase perf_phase;
+
+  /* Invalidate before and after the call because a callback might
+     call ngtcp2_conn_get_expiry in the middle. */
+  conn_invalidate_expiry(conn);
+
+  if (conn->local.settings.decrypt_in_place) {
+    conn->rx.pkt_begin = pkt;
+    conn->rx.pkt_end = pkt + pktlen;
+  }
+
+  perf_phase = ngtcp2_perf_switch(&conn->perf, NGTCP2_PERF_PHASE_OTHER);
+  rv = conn_read_pkts(conn, path, pkt_info_version, pi, pkt, pktlen, segsize,
+                      ts);
+  ngtcp2_perf_switch(&conn->perf, perf_phase);
+
+  conn->rx.pkt_begin = conn->rx.pkt_end = NULL;
+
+  conn_publish_conn_stat(conn);
+
+  conn_invalidate_expiry(conn);
+
+  return rv;
+}
+
+void ngtcp2_conn_prefetch(const ngtcp2_conn *conn) {
+  const ngtcp2_pktns *pktns = &conn->pktns;
+
+  ngtcp2_prefetch(conn);
+  ngtcp2_prefetch(&conn->dcid.current);
+  ngtcp2_prefetch(&pktns->rx);
+  ngtcp2_prefetch(&pktns->acktr);
+  ngtcp2_prefetch(&conn->cstat);
+
+  /* The key is allocated separately from conn. */
+  if (pktns->crypto.rx.ckm) {
+    ngtcp2_prefetch(pktns->crypto.rx.ckm);
+  }
+}
+
 /*
  * conn_check_pkt_num_exhausted returns nonzero if packet number is
  * exhausted in at least one of packet number space.
@@ -10341,8 +12841,10 @@ static ngtcp2_ssize conn_client_write_handshake(ngtcp2_conn *conn,
 }
 
 void ngtcp2_conn_handshake_completed(ngtcp2_conn *conn) {
+  conn_invalidate_expiry(conn);
+
   conn->flags |= NGTCP2_CONN_FLAG_HANDSHAKE_COMPLETED;
-  if (conn->server) {
+  if (conn_is_server(conn)) {
     conn->flags |= NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED;
   }
 }
@@ -10413,6 +12915,8 @@ int ngtcp2_conn_install_initial_key(
   ngtcp2_pktns *pktns = conn->in_pktns;
   int rv;
 
+  conn_invalidate_expiry(conn);
+
   assert(ivlen >= 8);
   assert(pktns);
 
@@ -10464,6 +12968,8 @@ int ngtcp2_conn_install_vneg_initial_key(
     const ngtcp2_crypto_cipher_ctx *tx_hp_ctx, size_t ivlen) {
   int rv;
 
+  conn_invalidate_expiry(conn);
+
   assert(ivlen >= 8);
 
   conn_call_delete_crypto_cipher_ctx(conn, &conn->vneg.rx.hp_ctx);
@@ -10513,6 +13019,8 @@ int ngtcp2_conn_install_rx_handshake_key(
   ngtcp2_pktns *pktns = conn->hs_pktns;
   int rv;
 
+  conn_invalidate_expiry(conn);
+
   assert(ivlen >= 8);
   assert(pktns);
   assert(!pktns->crypto.rx.hp_ctx.native_handle);
@@ -10545,6 +13053,8 @@ int ngtcp2_conn_install_tx_handshake_key(
   ngtcp2_pktns *pktns = conn->hs_pktns;
   int rv;
 
+  conn_invalidate_expiry(conn);
+
   assert(ivlen >= 8);
   assert(pktns);
   assert(!pktns->crypto.tx.hp_ctx.native_handle);
@@ -10558,7 +13068,7 @@ int ngtcp2_conn_install_tx_handshake_key(
 
   pktns->crypto.tx.hp_ctx = *hp_ctx;
 
-  if (conn->server) {
+  if (conn_is_server(conn)) {
     rv = ngtcp2_conn_commit_local_transport_params(conn);
     if (rv != 0) {
       return rv;
@@ -10584,6 +13094,8 @@ int ngtcp2_conn_install_early_key(ngtcp2_conn *conn,
                                   const ngtcp2_crypto_cipher_ctx *hp_ctx) {
   int rv;
 
+  conn_invalidate_expiry(conn);
+
   assert(ivlen >= 8);
   assert(!conn->early.hp_ctx.native_handle);
   assert(!conn->early.ckm);
@@ -10598,7 +13110,7 @@ int ngtcp2_conn_install_early_key(ngtcp2_conn *conn,
 
   conn->flags |= NGTCP2_CONN_FLAG_EARLY_KEY_INSTALLED;
 
-  if (conn->server) {
+  if (conn_is_server(conn)) {
     rv = conn_call_recv_rx_key(conn, NGTCP2_CRYPTO_LEVEL_EARLY);
   } else {
     rv = conn_call_recv_tx_key(conn, NGTCP2_CRYPTO_LEVEL_EARLY);
@@ -10623,6 +13135,8 @@ int ngtcp2_conn_install_rx_key(ngtcp2_conn *conn, const uint8_t *secret,
   ngtcp2_pktns *pktns = &conn->pktns;
   int rv;
 
+  conn_invalidate_expiry(conn);
+
   assert(ivlen >= 8);
   assert(!pktns->crypto.rx.hp_ctx.native_handle);
   assert(!pktns->crypto.rx.ckm);
@@ -10635,9 +13149,9 @@ int ngtcp2_conn_install_rx_key(ngtcp2_conn *conn, const uint8_t *secret,
 
   pktns->crypto.rx.hp_ctx = *hp_ctx;
 
-  if (!conn->server) {
+  if (!conn_is_server(conn)) {
     if (conn->remote.pending_transport_params) {
-      ngtcp2_transport_params_del(conn->remote.transport_params, conn->mem);
+      conn_del_remote_transport_params(conn, conn->remote.transport_params);
 
       conn->remote.transport_params = conn->remote.pending_transport_params;
       conn->remote.pending_transport_params = NULL;
@@ -10671,6 +13185,8 @@ int ngtcp2_conn_install_tx_key(ngtcp2_conn *conn, const uint8_t *secret,
   ngtcp2_pktns *pktns = &conn->pktns;
   int rv;
 
+  conn_invalidate_expiry(conn);
+
   assert(ivlen >= 8);
   assert(!pktns->crypto.tx.hp_ctx.native_handle);
   assert(!pktns->crypto.tx.ckm);
@@ -10681,11 +13197,12 @@ int ngtcp2_conn_install_tx_key(ngtcp2_conn *conn, const uint8_t *secret,
     return rv;
   }
 
+  pktns->crypto.tx.ckm->use_count = conn->crypto.restored_tx_use_count;
   pktns->crypto.tx.hp_ctx = *hp_ctx;
 
-  if (conn->server) {
+  if (conn_is_server(conn)) {
     if (conn->remote.pending_transport_params) {
-      ngtcp2_transport_params_del(conn->remote.transport_params, conn->mem);
+      conn_del_remote_transport_params(conn, conn->remote.transport_params);
 
       conn->remote.transport_params = conn->remote.pending_transport_params;
       conn->remote.pending_transport_params = NULL;
@@ -10696,7 +13213,11 @@ int ngtcp2_conn_install_tx_key(ngtcp2_conn *conn, const uint8_t *secret,
     conn_discard_early_key(conn);
   }
 
-  rv = conn_call_recv_tx_key(conn, NGTCP2_CRYPTO_LEVEL_APPLICATION);
+  rv = conn_call_offload_tx_key(conn, conn->crypto.key_update.tx_key_id,
+                                pktns->crypto.tx.ckm);
+  if (rv == 0) {
+    rv = conn_call_recv_tx_key(conn, NGTCP2_CRYPTO_LEVEL_APPLICATION);
+  }
   if (rv != 0) {
     ngtcp2_crypto_km_del(pktns->crypto.tx.ckm, conn->mem);
     pktns->crypto.tx.ckm = NULL;
@@ -10709,9 +13230,27 @@ int ngtcp2_conn_install_tx_key(ngtcp2_conn *conn, const uint8_t *secret,
   return 0;
 }
 
+int ngtcp2_conn_prepare_key_update(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
+  int rv;
+
+  if (conn->state != NGTCP2_CS_POST_HANDSHAKE) {
+    return NGTCP2_ERR_INVALID_STATE;
+  }
+
+  rv = conn_prepare_key_update(conn, ts);
+  if (rv != 0) {
+    return rv;
+  }
+
+  return 0;
+}
+
 int ngtcp2_conn_initiate_key_update(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
   ngtcp2_tstamp confirmed_ts = conn->crypto.key_update.confirmed_ts;
   ngtcp2_duration pto = conn_compute_pto(conn, &conn->pktns);
+  int rv;
+
+  conn_invalidate_expiry(conn);
 
   assert(conn->state == NGTCP2_CS_POST_HANDSHAKE);
 
@@ -10723,6 +13262,11 @@ int ngtcp2_conn_initiate_key_update(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
     return NGTCP2_ERR_INVALID_STATE;
   }
 
+  rv = conn_protect_pkts(conn);
+  if (rv != 0) {
+    return rv;
+  }
+
   conn_rotate_keys(conn, NGTCP2_MAX_PKT_NUM, /* initiator = */ 1);
 
   return 0;
@@ -10826,7 +13370,7 @@ ngtcp2_tstamp ngtcp2_conn_internal_expiry(ngtcp2_conn *conn) {
     }
   }
 
-  if (conn->server && conn->early.ckm &&
+  if (conn_is_server(conn) && conn->early.ckm &&
       conn->early.discard_started_ts != UINT64_MAX) {
     t = conn->early.discard_started_ts + 3 * pto;
     res = ngtcp2_min(res, t);
@@ -10855,7 +13399,11 @@ static ngtcp2_tstamp conn_handshake_expiry(ngtcp2_conn *conn) {
          conn->local.settings.handshake_timeout;
 }
 
-ngtcp2_tstamp ngtcp2_conn_get_expiry(ngtcp2_conn *conn) {
+/*
+ * conn_compute_expiry returns the earliest expiry of all timers of
+ * |conn|.
+ */
+static ngtcp2_tstamp conn_compute_expiry(ngtcp2_conn *conn) {
   ngtcp2_tstamp t1 = ngtcp2_conn_loss_detection_expiry(conn);
   ngtcp2_tstamp t2 = ngtcp2_conn_ack_delay_expiry(conn);
   ngtcp2_tstamp t3 = ngtcp2_conn_internal_expiry(conn);
@@ -10869,10 +13417,35 @@ ngtcp2_tstamp ngtcp2_conn_get_expiry(ngtcp2_conn *conn) {
   res = ngtcp2_min(res, t5);
   res = ngtcp2_min(res, t6);
   res = ngtcp2_min(res, t7);
+
+  if (conn->tx.flow_update.first_ts != UINT64_MAX) {
+    res = ngtcp2_min(res, conn->tx.flow_update.first_ts +
+                              conn->cstat.smoothed_rtt / 4);
+  }
+
+  if (conn->tx.pacing.next_ts != UINT64_MAX &&
+      conn->local.settings.pacing_horizon) {
+    /* Wake up early enough to write the next batch ahead of its
+       departure time. */
+    return ngtcp2_min(res,
+                      conn->tx.pacing.next_ts -
+                          ngtcp2_min(conn->tx.pacing.next_ts,
+                                     conn->local.settings.pacing_horizon));
+  }
+
   return ngtcp2_min(res, conn->tx.pacing.next_ts);
 }
 
-int ngtcp2_conn_handle_expiry(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
+ngtcp2_tstamp ngtcp2_conn_get_expiry(ngtcp2_conn *conn) {
+  if (!(conn->flags & NGTCP2_CONN_FLAG_EXPIRY_VALID)) {
+    conn->expiry = conn_compute_expiry(conn);
+    conn->flags |= NGTCP2_CONN_FLAG_EXPIRY_VALID;
+  }
+
+  return conn->expiry;
+}
+
+static int conn_handle_expiry(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
   int rv;
   ngtcp2_duration pto = conn_compute_pto(conn, &conn->pktns);
 
@@ -10886,6 +13459,14 @@ int ngtcp2_conn_handle_expiry(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
 
   conn_cancel_expired_pkt_tx_timer(conn, ts);
 
+  if (conn->tx.flow_update.first_ts != UINT64_MAX &&
+      conn->tx.flow_update.first_ts + conn->cstat.smoothed_rtt / 4 <= ts) {
+    /* The deferred flow control updates go in the next packet
+       whatever else it carries. */
+    conn->tx.flow_update.first_ts = UINT64_MAX;
+    conn->tx.flow_update.urgent = 1;
+  }
+
   ngtcp2_conn_remove_lost_pkt(conn, ts);
 
   if (conn->pv) {
@@ -10918,7 +13499,7 @@ int ngtcp2_conn_handle_expiry(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
     return rv;
   }
 
-  if (conn->server && conn->early.ckm &&
+  if (conn_is_server(conn) && conn->early.ckm &&
       conn->early.discard_started_ts != UINT64_MAX) {
     if (conn->early.discard_started_ts + 3 * pto <= ts) {
       conn_discard_early_key(conn);
@@ -10936,8 +13517,20 @@ int ngtcp2_conn_handle_expiry(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
   return 0;
 }
 
-static void acktr_cancel_expired_ack_delay_timer(ngtcp2_acktr *acktr,
-                                                 ngtcp2_duration max_ack_delay,
+int ngtcp2_conn_handle_expiry(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
+  int rv;
+
+  conn_invalidate_expiry(conn);
+
+  rv = conn_handle_expiry(conn, ts);
+
+  conn_invalidate_expiry(conn);
+
+  return rv;
+}
+
+static void acktr_cancel_expired_ack_delay_timer(ngtcp2_acktr *acktr,
+                                                 ngtcp2_duration max_ack_delay,
                                                  ngtcp2_tstamp ts) {
   if (!(acktr->flags & NGTCP2_ACKTR_FLAG_CANCEL_TIMER) &&
       acktr->first_unacked_ts != UINT64_MAX &&
@@ -11054,7 +13647,7 @@ static uint32_t select_preferred_version(const uint32_t *preferred_versions,
 static int
 conn_client_validate_transport_params(ngtcp2_conn *conn,
                                       const ngtcp2_transport_params *params) {
-  if (!ngtcp2_cid_eq(&conn->rcid, &params->original_dcid)) {
+  if (!ngtcp2_cid_eq_inline(&conn->rcid, &params->original_dcid)) {
     return NGTCP2_ERR_TRANSPORT_PARAM;
   }
 
@@ -11062,7 +13655,7 @@ conn_client_validate_transport_params(ngtcp2_conn *conn,
     if (!params->retry_scid_present) {
       return NGTCP2_ERR_TRANSPORT_PARAM;
     }
-    if (!ngtcp2_cid_eq(&conn->retry_scid, &params->retry_scid)) {
+    if (!ngtcp2_cid_eq_inline(&conn->retry_scid, &params->retry_scid)) {
       return NGTCP2_ERR_TRANSPORT_PARAM;
     }
   } else if (params->retry_scid_present) {
@@ -11136,6 +13729,8 @@ int ngtcp2_conn_set_remote_transport_params(
     ngtcp2_conn *conn, const ngtcp2_transport_params *params) {
   int rv;
 
+  conn_invalidate_expiry(conn);
+
   /* We expect this function is called once per QUIC connection, but
      GnuTLS server seems to call TLS extension callback twice if it
      sends HelloRetryRequest.  In practice, same QUIC transport
@@ -11155,7 +13750,7 @@ int ngtcp2_conn_set_remote_transport_params(
   /* We assume that conn->dcid.current.cid is still the initial one.
      This requires that transport parameter must be fed into
      ngtcp2_conn as early as possible. */
-  if (!ngtcp2_cid_eq(&conn->dcid.current.cid, &params->initial_scid)) {
+  if (!ngtcp2_cid_eq_inline(&conn->dcid.current.cid, &params->initial_scid)) {
     return NGTCP2_ERR_TRANSPORT_PARAM;
   }
 
@@ -11163,7 +13758,7 @@ int ngtcp2_conn_set_remote_transport_params(
     return NGTCP2_ERR_TRANSPORT_PARAM;
   }
 
-  if (conn->server) {
+  if (conn_is_server(conn)) {
     if (params->version_info_present) {
       if (params->version_info.chosen_version != conn->client_chosen_version) {
         return NGTCP2_ERR_VERSION_NEGOTIATION_FAILURE;
@@ -11196,21 +13791,21 @@ int ngtcp2_conn_set_remote_transport_params(
   }
 
   ngtcp2_log_remote_tp(&conn->log,
-                       conn->server
+                       conn_is_server(conn)
                            ? NGTCP2_TRANSPORT_PARAMS_TYPE_CLIENT_HELLO
                            : NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS,
                        params);
 
-  ngtcp2_qlog_parameters_set_transport_params(&conn->qlog, params, conn->server,
-                                              NGTCP2_QLOG_SIDE_REMOTE);
+  ngtcp2_qlog_parameters_set_transport_params(
+      &conn->qlog, params, conn_is_server(conn), NGTCP2_QLOG_SIDE_REMOTE);
 
-  if ((conn->server && conn->pktns.crypto.tx.ckm) ||
-      (!conn->server && conn->pktns.crypto.rx.ckm)) {
-    ngtcp2_transport_params_del(conn->remote.transport_params, conn->mem);
+  if ((conn_is_server(conn) && conn->pktns.crypto.tx.ckm) ||
+      (!conn_is_server(conn) && conn->pktns.crypto.rx.ckm)) {
+    conn_del_remote_transport_params(conn, conn->remote.transport_params);
     conn->remote.transport_params = NULL;
 
-    rv = ngtcp2_transport_params_copy_new(&conn->remote.transport_params,
-                                          params, conn->mem);
+    rv = conn_copy_remote_transport_params(
+        conn, &conn->remote.transport_params, params);
     if (rv != 0) {
       return rv;
     }
@@ -11219,8 +13814,8 @@ int ngtcp2_conn_set_remote_transport_params(
   } else {
     assert(!conn->remote.pending_transport_params);
 
-    rv = ngtcp2_transport_params_copy_new(
-        &conn->remote.pending_transport_params, params, conn->mem);
+    rv = conn_copy_remote_transport_params(
+        conn, &conn->remote.pending_transport_params, params);
     if (rv != 0) {
       return rv;
     }
@@ -11239,8 +13834,8 @@ int ngtcp2_conn_decode_remote_transport_params(ngtcp2_conn *conn,
 
   rv = ngtcp2_decode_transport_params(
       &params,
-      conn->server ? NGTCP2_TRANSPORT_PARAMS_TYPE_CLIENT_HELLO
-                   : NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS,
+      conn_is_server(conn) ? NGTCP2_TRANSPORT_PARAMS_TYPE_CLIENT_HELLO
+                           : NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS,
       data, datalen);
   if (rv != 0) {
     return rv;
@@ -11264,11 +13859,13 @@ void ngtcp2_conn_set_early_remote_transport_params_versioned(
   ngtcp2_transport_params *p;
   (void)transport_params_version;
 
+  conn_invalidate_expiry(conn);
+
   assert(!conn->server);
   assert(!conn->remote.transport_params);
 
-  /* Assume that all pointer fields in p are NULL */
-  p = ngtcp2_mem_calloc(conn->mem, 1, sizeof(*p));
+  p = &conn_vacant_remote_transport_params_storage(conn)->params;
+  memset(p, 0, sizeof(*p));
 
   conn->remote.transport_params = p;
 
@@ -11316,8 +13913,8 @@ void ngtcp2_conn_set_early_remote_transport_params_versioned(
 
   conn->tx.max_offset = p->initial_max_data;
 
-  ngtcp2_qlog_parameters_set_transport_params(&conn->qlog, p, conn->server,
-                                              NGTCP2_QLOG_SIDE_REMOTE);
+  ngtcp2_qlog_parameters_set_transport_params(
+      &conn->qlog, p, conn_is_server(conn), NGTCP2_QLOG_SIDE_REMOTE);
 }
 
 int ngtcp2_conn_set_local_transport_params_versioned(
@@ -11325,6 +13922,8 @@ int ngtcp2_conn_set_local_transport_params_versioned(
     const ngtcp2_transport_params *params) {
   (void)transport_params_version;
 
+  conn_invalidate_expiry(conn);
+
   assert(conn->server);
   assert(params->active_connection_id_limit <= NGTCP2_MAX_DCID_POOL_SIZE);
 
@@ -11343,6 +13942,8 @@ int ngtcp2_conn_commit_local_transport_params(ngtcp2_conn *conn) {
   ngtcp2_scid *scident;
   int rv;
 
+  conn_invalidate_expiry(conn);
+
   assert(1 == ngtcp2_ksl_len(&conn->scid.set));
 
   if (params->active_connection_id_limit == 0) {
@@ -11356,7 +13957,7 @@ int ngtcp2_conn_commit_local_transport_params(ngtcp2_conn *conn) {
     params->preferred_address_present = 0;
   }
 
-  if (conn->server && params->preferred_address_present) {
+  if (conn_is_server(conn) && params->preferred_address_present) {
     scident = ngtcp2_mem_malloc(mem, sizeof(*scident));
     if (scident == NULL) {
       return NGTCP2_ERR_NOMEM;
@@ -11377,13 +13978,15 @@ int ngtcp2_conn_commit_local_transport_params(ngtcp2_conn *conn) {
       params->initial_max_data;
   conn->remote.bidi.unsent_max_streams = params->initial_max_streams_bidi;
   conn->remote.bidi.max_streams = params->initial_max_streams_bidi;
+  conn->remote.bidi.window = params->initial_max_streams_bidi;
   conn->remote.uni.unsent_max_streams = params->initial_max_streams_uni;
   conn->remote.uni.max_streams = params->initial_max_streams_uni;
+  conn->remote.uni.window = params->initial_max_streams_uni;
 
   conn->flags |= NGTCP2_CONN_FLAG_LOCAL_TRANSPORT_PARAMS_COMMITTED;
 
-  ngtcp2_qlog_parameters_set_transport_params(&conn->qlog, params, conn->server,
-                                              NGTCP2_QLOG_SIDE_LOCAL);
+  ngtcp2_qlog_parameters_set_transport_params(
+      &conn->qlog, params, conn_is_server(conn), NGTCP2_QLOG_SIDE_LOCAL);
 
   return 0;
 }
@@ -11396,10 +13999,15 @@ ngtcp2_conn_get_local_transport_params(ngtcp2_conn *conn) {
 ngtcp2_ssize ngtcp2_conn_encode_local_transport_params(ngtcp2_conn *conn,
                                                        uint8_t *dest,
                                                        size_t destlen) {
+  if (conn_is_server(conn)) {
+    return ngtcp2_encode_transport_params_template(
+        dest, destlen, NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS,
+        &conn->local.transport_params,
+        conn->local.settings.transport_params_template);
+  }
+
   return ngtcp2_encode_transport_params(
-      dest, destlen,
-      conn->server ? NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS
-                   : NGTCP2_TRANSPORT_PARAMS_TYPE_CLIENT_HELLO,
+      dest, destlen, NGTCP2_TRANSPORT_PARAMS_TYPE_CLIENT_HELLO,
       &conn->local.transport_params);
 }
 
@@ -11412,7 +14020,7 @@ int ngtcp2_conn_open_bidi_stream(ngtcp2_conn *conn, int64_t *pstream_id,
     return NGTCP2_ERR_STREAM_ID_BLOCKED;
   }
 
-  strm = ngtcp2_objalloc_strm_get(&conn->strm_objalloc);
+  strm = ngtcp2_objalloc_strm_get(conn->strm_objalloc);
   if (strm == NULL) {
     return NGTCP2_ERR_NOMEM;
   }
@@ -11420,7 +14028,7 @@ int ngtcp2_conn_open_bidi_stream(ngtcp2_conn *conn, int64_t *pstream_id,
   rv = ngtcp2_conn_init_stream(conn, strm, conn->local.bidi.next_stream_id,
                                stream_user_data);
   if (rv != 0) {
-    ngtcp2_objalloc_strm_release(&conn->strm_objalloc, strm);
+    ngtcp2_objalloc_strm_release(conn->strm_objalloc, strm);
     return rv;
   }
 
@@ -11439,7 +14047,7 @@ int ngtcp2_conn_open_uni_stream(ngtcp2_conn *conn, int64_t *pstream_id,
     return NGTCP2_ERR_STREAM_ID_BLOCKED;
   }
 
-  strm = ngtcp2_objalloc_strm_get(&conn->strm_objalloc);
+  strm = ngtcp2_objalloc_strm_get(conn->strm_objalloc);
   if (strm == NULL) {
     return NGTCP2_ERR_NOMEM;
   }
@@ -11447,7 +14055,7 @@ int ngtcp2_conn_open_uni_stream(ngtcp2_conn *conn, int64_t *pstream_id,
   rv = ngtcp2_conn_init_stream(conn, strm, conn->local.uni.next_stream_id,
                                stream_user_data);
   if (rv != 0) {
-    ngtcp2_objalloc_strm_release(&conn->strm_objalloc, strm);
+    ngtcp2_objalloc_strm_release(conn->strm_objalloc, strm);
     return rv;
   }
   ngtcp2_strm_shutdown(strm, NGTCP2_STRM_FLAG_SHUT_RD);
@@ -11477,6 +14085,56 @@ ngtcp2_ssize ngtcp2_conn_write_stream_versioned(
                                              stream_id, &datav, 1, ts);
 }
 
+/*
+ * conn_stall_cause returns the reason why the write call with |vmsg|
+ * at |ts| wrote nothing.  |nwrite| is the return value of the call.
+ */
+static ngtcp2_stall_cause conn_stall_cause(ngtcp2_conn *conn,
+                                           ngtcp2_ssize nwrite,
+                                           const ngtcp2_vmsg *vmsg,
+                                           ngtcp2_tstamp ts) {
+  if (nwrite == NGTCP2_ERR_STREAM_DATA_BLOCKED) {
+    return NGTCP2_STALL_CAUSE_STREAM_FLOW_CONTROL;
+  }
+
+  if (!conn_pacing_pkt_tx_allowed(conn, ts)) {
+    return NGTCP2_STALL_CAUSE_PACING;
+  }
+
+  if (!conn->pktns.rtb.probe_pkt_left &&
+      conn->cstat.bytes_in_flight >= conn_get_cwnd(conn)) {
+    return NGTCP2_STALL_CAUSE_CWND;
+  }
+
+  if (vmsg && vmsg->type == NGTCP2_VMSG_TYPE_STREAM &&
+      conn->tx.max_offset == conn->tx.offset) {
+    return NGTCP2_STALL_CAUSE_CONN_FLOW_CONTROL;
+  }
+
+  return NGTCP2_STALL_CAUSE_APP;
+}
+
+/*
+ * conn_update_stall records the cause that limited the write call
+ * with |vmsg| at |ts| which returned |nwrite|.
+ */
+static void conn_update_stall(ngtcp2_conn *conn, ngtcp2_ssize nwrite,
+                              const ngtcp2_vmsg *vmsg, ngtcp2_tstamp ts) {
+  ngtcp2_stall_cause cause;
+
+  if (nwrite > 0) {
+    cause = NGTCP2_STALL_CAUSE_NONE;
+  } else if (nwrite == 0 || nwrite == NGTCP2_ERR_STREAM_DATA_BLOCKED) {
+    cause = conn_stall_cause(conn, nwrite, vmsg, ts);
+  } else {
+    return;
+  }
+
+  if (ngtcp2_stall_update(&conn->stall, cause, ts)) {
+    ngtcp2_qlog_send_limited(&conn->qlog, cause);
+  }
+}
+
 static ngtcp2_ssize conn_write_vmsg_wrapper(ngtcp2_conn *conn,
                                             ngtcp2_path *path,
                                             int pkt_info_version,
@@ -11487,8 +14145,17 @@ static ngtcp2_ssize conn_write_vmsg_wrapper(ngtcp2_conn *conn,
   ngtcp2_ssize nwrite;
   int undersized;
 
+  if (conn_protect_jobs_blocked(conn)) {
+    return 0;
+  }
+
   nwrite = ngtcp2_conn_write_vmsg(conn, path, pkt_info_version, pi, dest,
                                   destlen, vmsg, ts);
+
+  conn_update_stall(conn, nwrite, vmsg, ts);
+
+  conn_publish_conn_stat(conn);
+
   if (nwrite < 0) {
     return nwrite;
   }
@@ -11525,6 +14192,8 @@ ngtcp2_ssize ngtcp2_conn_writev_stream_versioned(
   ngtcp2_vmsg vmsg, *pvmsg;
   ngtcp2_strm *strm;
   int64_t datalen;
+  ngtcp2_vec sendbufv[NGTCP2_STRM_SENDBUF_MAX_VECCNT];
+  uint64_t unsentlen;
 
   if (pdatalen) {
     *pdatalen = -1;
@@ -11540,6 +14209,27 @@ ngtcp2_ssize ngtcp2_conn_writev_stream_versioned(
       return NGTCP2_ERR_STREAM_SHUT_WR;
     }
 
+    if (strm->tx.sendbuf) {
+      if (ngtcp2_vec_len(datav, datavcnt)) {
+        return NGTCP2_ERR_INVALID_ARGUMENT;
+      }
+
+      datavcnt = ngtcp2_strm_sendbuf_get_unsent(
+          strm, sendbufv, sizeof(sendbufv) / sizeof(sendbufv[0]), &unsentlen);
+      datav = sendbufv;
+
+      if (strm->tx.sendbuf->fin) {
+        if (strm->tx.offset + unsentlen == strm->tx.sendbuf->end) {
+          flags |= NGTCP2_WRITE_STREAM_FLAG_FIN;
+        }
+      } else if (unsentlen == 0) {
+        /* Nothing to send for this stream, but the other frames
+           might be. */
+        return conn_write_vmsg_wrapper(conn, path, pkt_info_version, pi,
+                                       dest, destlen, NULL, ts);
+      }
+    }
+
     datalen = ngtcp2_vec_len_varint(datav, datavcnt);
     if (datalen == -1) {
       return NGTCP2_ERR_INVALID_ARGUMENT;
@@ -11566,6 +14256,190 @@ ngtcp2_ssize ngtcp2_conn_writev_stream_versioned(
                                  destlen, pvmsg, ts);
 }
 
+/*
+ * stream_write_datav assigns the data of |sw| which is not sent yet
+ * to |vec| of length |veccnt|, and returns the number of elements
+ * assigned.  |*pdatalen| is the length of the assigned data.
+ */
+static size_t stream_write_datav(ngtcp2_vec *vec, size_t veccnt,
+                                 uint64_t *pdatalen,
+                                 const ngtcp2_stream_write *sw) {
+  uint64_t skip = sw->ndatalen, datalen = 0;
+  size_t i, n = 0;
+
+  for (i = 0; i < sw->datavcnt && n < veccnt; ++i) {
+    if (skip >= sw->datav[i].len) {
+      skip -= sw->datav[i].len;
+      continue;
+    }
+
+    vec[n].base = sw->datav[i].base + skip;
+    vec[n].len = sw->datav[i].len - (size_t)skip;
+    datalen += vec[n].len;
+    ++n;
+    skip = 0;
+  }
+
+  *pdatalen = datalen;
+
+  return n;
+}
+
+/*
+ * conn_writev_streams writes packets containing the data of |sw| of
+ * length |swcnt| back to back.  It writes at most |max_pkts| packets
+ * if |max_pkts| is nonzero.  If |burst| is nonzero, each packet is at
+ * most the maximum UDP payload size of the current path, and it is
+ * padded to that size while |sw| has data left to send.  See
+ * ngtcp2_conn_writev_streams_versioned for the other parameters.
+ */
+static ngtcp2_ssize
+conn_writev_streams(ngtcp2_conn *conn, ngtcp2_path *path, int pkt_info_version,
+                    ngtcp2_pkt_info *pi, uint8_t *dest, size_t destlen,
+                    size_t max_pkts, int burst, size_t *pgsolen,
+                    ngtcp2_stream_write *sw, size_t swcnt, ngtcp2_tstamp ts) {
+  ngtcp2_vec vec[NGTCP2_MAX_STREAM_DATACNT];
+  size_t veccnt;
+  uint64_t datalen, total;
+  uint8_t *wbuf = dest;
+  size_t max_udp_payload_size = conn->local.settings.max_udp_payload_size;
+  size_t gsolen = 0, left, i, npkts = 0;
+  ngtcp2_pkt_info lpi;
+  ngtcp2_ssize nwrite, ndatalen;
+  int64_t stream_id;
+  uint32_t flags;
+
+  if (burst) {
+    max_udp_payload_size = conn_shape_udp_payload(conn, &conn->dcid.current,
+                                                  max_udp_payload_size);
+  }
+
+  destlen = ngtcp2_min(destlen, ngtcp2_max(conn->cstat.send_quantum,
+                                           max_udp_payload_size));
+
+  for (i = 0; i < swcnt; ++i) {
+    sw[i].ndatalen = 0;
+  }
+
+  for (i = 0;;) {
+    left = (size_t)(dest + destlen - wbuf);
+    if (left == 0 || (max_pkts && npkts == max_pkts)) {
+      break;
+    }
+
+    for (; i < swcnt; ++i) {
+      if (ngtcp2_vec_len(sw[i].datav, sw[i].datavcnt) ||
+          (sw[i].flags & NGTCP2_WRITE_STREAM_FLAG_FIN)) {
+        break;
+      }
+    }
+
+    if (i < swcnt) {
+      stream_id = sw[i].stream_id;
+      veccnt = stream_write_datav(vec, sizeof(vec) / sizeof(vec[0]), &datalen,
+                                  &sw[i]);
+      total = ngtcp2_vec_len(sw[i].datav, sw[i].datavcnt);
+      flags = NGTCP2_WRITE_STREAM_FLAG_MORE;
+
+      /* Set fin only if vec covers the rest of the data. */
+      if ((sw[i].flags & NGTCP2_WRITE_STREAM_FLAG_FIN) &&
+          sw[i].ndatalen + datalen == total) {
+        flags |= NGTCP2_WRITE_STREAM_FLAG_FIN;
+      }
+
+      if (burst) {
+        flags |= NGTCP2_WRITE_STREAM_FLAG_PADDING;
+      }
+    } else {
+      stream_id = -1;
+      veccnt = 0;
+      datalen = total = 0;
+      flags = NGTCP2_WRITE_STREAM_FLAG_NONE;
+    }
+
+    nwrite = ngtcp2_conn_writev_stream_versioned(
+        conn, gsolen ? NULL : path, pkt_info_version, gsolen ? &lpi : pi,
+        wbuf, gsolen ? ngtcp2_min(left, gsolen)
+                     : ngtcp2_min(left, max_udp_payload_size),
+        &ndatalen, flags, stream_id, vec, veccnt, ts);
+    if (nwrite < 0) {
+      switch (nwrite) {
+      case NGTCP2_ERR_STREAM_NOT_FOUND:
+      case NGTCP2_ERR_STREAM_SHUT_WR:
+      case NGTCP2_ERR_STREAM_DATA_BLOCKED:
+        assert(ndatalen == -1);
+        ++i;
+        continue;
+      case NGTCP2_ERR_WRITE_MORE:
+        assert(ndatalen >= 0);
+        break;
+      default:
+        return nwrite;
+      }
+    }
+
+    if (ndatalen >= 0) {
+      sw[i].ndatalen += (uint64_t)ndatalen;
+      if ((uint64_t)ndatalen == datalen && sw[i].ndatalen == total) {
+        ++i;
+      }
+    }
+
+    if (nwrite == NGTCP2_ERR_WRITE_MORE) {
+      continue;
+    }
+
+    if (nwrite == 0) {
+      break;
+    }
+
+    wbuf += nwrite;
+    ++npkts;
+
+    if (gsolen == 0) {
+      gsolen = (size_t)nwrite;
+    } else if ((size_t)nwrite < gsolen) {
+      break;
+    }
+
+    /* A short packet is not padded because nothing is left to send,
+       or the buffer is used up. */
+    if (burst && (size_t)nwrite < max_udp_payload_size) {
+      break;
+    }
+
+    /* The next packet might be sent to the other path, or with the
+       other ECN codepoint. */
+    if (conn->pv || conn->tx.ecn.state == NGTCP2_ECN_STATE_TESTING) {
+      break;
+    }
+  }
+
+  if (pgsolen) {
+    *pgsolen = gsolen;
+  }
+
+  return wbuf - dest;
+}
+
+ngtcp2_ssize ngtcp2_conn_writev_streams_versioned(
+    ngtcp2_conn *conn, ngtcp2_path *path, int pkt_info_version,
+    ngtcp2_pkt_info *pi, uint8_t *dest, size_t destlen, size_t *pgsolen,
+    ngtcp2_stream_write *sw, size_t swcnt, ngtcp2_tstamp ts) {
+  return conn_writev_streams(conn, path, pkt_info_version, pi, dest, destlen,
+                             /* max_pkts = */ 0, /* burst = */ 0, pgsolen, sw,
+                             swcnt, ts);
+}
+
+ngtcp2_ssize ngtcp2_conn_write_burst_versioned(
+    ngtcp2_conn *conn, ngtcp2_path *path, int pkt_info_version,
+    ngtcp2_pkt_info *pi, uint8_t *dest, size_t destlen, size_t max_pkts,
+    size_t *pgsolen, ngtcp2_stream_write *sw, size_t swcnt, ngtcp2_tstamp ts) {
+  return conn_writev_streams(conn, path, pkt_info_version, pi, dest, destlen,
+                             max_pkts, /* burst = */ 1, pgsolen, sw, swcnt,
+                             ts);
+}
+
 ngtcp2_ssize ngtcp2_conn_writev_datagram_versioned(
     ngtcp2_conn *conn, ngtcp2_path *path, int pkt_info_version,
     ngtcp2_pkt_info *pi, uint8_t *dest, size_t destlen, int *paccepted,
@@ -11604,7 +14478,55 @@ ngtcp2_ssize ngtcp2_conn_writev_datagram_versioned(
                                  destlen, &vmsg, ts);
 }
 
-ngtcp2_ssize ngtcp2_conn_write_vmsg(ngtcp2_conn *conn, ngtcp2_path *path,
+int ngtcp2_conn_enqueue_datagram(ngtcp2_conn *conn, uint64_t dgram_id,
+                                 const ngtcp2_vec *datav, size_t datavcnt,
+                                 ngtcp2_tstamp expiry) {
+  ngtcp2_dgram_entry *ent;
+  int64_t datalen;
+
+  if (conn->remote.transport_params == NULL ||
+      conn->remote.transport_params->max_datagram_frame_size == 0) {
+    return NGTCP2_ERR_INVALID_STATE;
+  }
+
+  datalen = ngtcp2_vec_len_varint(datav, datavcnt);
+  if (datalen == -1 || (uint64_t)datalen > SIZE_MAX ||
+      conn->remote.transport_params->max_datagram_frame_size <
+          ngtcp2_pkt_datagram_framelen((size_t)datalen)) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  ent = ngtcp2_mem_malloc(
+      ngtcp2_mem_for_subsys(conn->mem, NGTCP2_MEM_SUBSYS_DGRAM),
+      sizeof(*ent) + sizeof(ngtcp2_vec) * datavcnt);
+  if (ent == NULL) {
+    return NGTCP2_ERR_NOMEM;
+  }
+
+  ent->next = NULL;
+  ent->dgram_id = dgram_id;
+  ent->expiry = expiry;
+  ent->datalen = (size_t)datalen;
+  ent->datacnt = datavcnt;
+  ent->data = (ngtcp2_vec *)(void *)(ent + 1);
+  ngtcp2_vec_copy(ent->data, datav, datavcnt);
+
+  if (conn->tx.dgramq_tail) {
+    conn->tx.dgramq_tail->next = ent;
+  } else {
+    conn->tx.dgramq = ent;
+  }
+  conn->tx.dgramq_tail = ent;
+  ++conn->tx.dgramq_len;
+
+  return 0;
+}
+
+size_t ngtcp2_conn_get_datagram_queue_len(ngtcp2_conn *conn) {
+  return conn->tx.dgramq_len;
+}
+
+static ngtcp2_ssize conn_write_vmsg(ngtcp2_conn *conn, ngtcp2_path *path,
                                     int pkt_info_version, ngtcp2_pkt_info *pi,
                                     uint8_t *dest, size_t destlen,
                                     ngtcp2_vmsg *vmsg, ngtcp2_tstamp ts) {
@@ -11620,13 +14542,17 @@ ngtcp2_ssize ngtcp2_conn_write_vmsg(ngtcp2_conn *conn, ngtcp2_path *path,
   uint64_t datalen;
   uint64_t write_datalen = 0;
   int64_t prev_in_pkt_num = -1;
-  ngtcp2_ksl_it it;
+  ngtcp2_rtb_it it;
   ngtcp2_rtb_entry *rtbent;
-  (void)pkt_info_version;
 
   conn->log.last_ts = ts;
   conn->qlog.last_ts = ts;
 
+  if (vmsg && vmsg->type == NGTCP2_VMSG_TYPE_STREAM &&
+      (vmsg->stream.flags & NGTCP2_WRITE_STREAM_FLAG_PADDING)) {
+    wflags |= NGTCP2_WRITE_PKT_FLAG_REQUIRE_PADDING;
+  }
+
   if (path) {
     ngtcp2_path_copy(path, &conn->dcid.current.ps.path);
   }
@@ -11636,6 +14562,19 @@ ngtcp2_ssize ngtcp2_conn_write_vmsg(ngtcp2_conn *conn, ngtcp2_path *path,
 
   if (!ppe_pending && pi) {
     pi->ecn = NGTCP2_ECN_NOT_ECT;
+
+    if (pkt_info_version >= NGTCP2_PKT_INFO_VERSION_V2) {
+      pi->tx_ts = conn_pkt_tx_time(conn, ts);
+    }
+
+    if (pkt_info_version >= NGTCP2_PKT_INFO_VERSION_V3) {
+      pi->offload_pktlen = 0;
+    }
+  }
+
+  if (pi && pkt_info_version >= NGTCP2_PKT_INFO_VERSION_V3 &&
+      conn->local.settings.crypto_offload) {
+    wflags |= NGTCP2_WRITE_PKT_FLAG_CRYPTO_OFFLOAD;
   }
 
   if (!conn_pacing_pkt_tx_allowed(conn, ts)) {
@@ -11680,6 +14619,8 @@ ngtcp2_ssize ngtcp2_conn_write_vmsg(ngtcp2_conn *conn, ngtcp2_path *path,
       if (!(conn->dcid.current.flags & NGTCP2_DCID_FLAG_PATH_VALIDATED)) {
         server_tx_left = conn_server_tx_left(conn, &conn->dcid.current);
         if (server_tx_left == 0) {
+          conn_amplification_blocked(conn, ts);
+
           if (cstat->loss_detection_timer != UINT64_MAX) {
             ngtcp2_log_info(
                 &conn->log, NGTCP2_LOG_EVENT_RCV,
@@ -11719,8 +14660,8 @@ ngtcp2_ssize ngtcp2_conn_write_vmsg(ngtcp2_conn *conn, ngtcp2_path *path,
 
         if (conn->in_pktns && write_datalen > 0) {
           it = ngtcp2_rtb_head(&conn->in_pktns->rtb);
-          if (!ngtcp2_ksl_it_end(&it)) {
-            rtbent = ngtcp2_ksl_it_get(&it);
+          if (!ngtcp2_rtb_it_end(&it)) {
+            rtbent = ngtcp2_rtb_it_get(&it);
             prev_in_pkt_num = rtbent->hd.pkt_num;
           }
         }
@@ -11737,8 +14678,8 @@ ngtcp2_ssize ngtcp2_conn_write_vmsg(ngtcp2_conn *conn, ngtcp2_path *path,
 
       if (conn->in_pktns && write_datalen > 0) {
         it = ngtcp2_rtb_head(&conn->in_pktns->rtb);
-        if (!ngtcp2_ksl_it_end(&it)) {
-          rtbent = ngtcp2_ksl_it_get(&it);
+        if (!ngtcp2_rtb_it_end(&it)) {
+          rtbent = ngtcp2_rtb_it_get(&it);
           if (rtbent->hd.pkt_num != prev_in_pkt_num &&
               (rtbent->flags & NGTCP2_RTB_ENTRY_FLAG_ACK_ELICITING)) {
             /* We have added padding already, but in that case, there
@@ -11806,6 +14747,13 @@ ngtcp2_ssize ngtcp2_conn_write_vmsg(ngtcp2_conn *conn, ngtcp2_path *path,
       if (rv != 0) {
         return rv;
       }
+
+      if (conn->local.settings.ack_freq) {
+        rv = conn_enqueue_ack_frequency(conn, ts);
+        if (rv != 0) {
+          return rv;
+        }
+      }
     }
 
     if (!conn->pktns.rtb.probe_pkt_left && conn_cwnd_is_zero(conn)) {
@@ -11828,26 +14776,30 @@ ngtcp2_ssize ngtcp2_conn_write_vmsg(ngtcp2_conn *conn, ngtcp2_path *path,
 
         if (conn->pmtud &&
             (!conn->hs_pktns ||
-             ngtcp2_ksl_len(&conn->hs_pktns->crypto.tx.frq) == 0)) {
-          nwrite = conn_write_pmtud_probe(conn, pi, dest, origdestlen, ts);
+             conn->hs_pktns->crypto.tx.frq.len == 0)) {
+          nwrite =
+              conn_write_pmtud_probe(conn, pi, dest, origdestlen, vmsg, ts);
           if (nwrite) {
             goto fin;
           }
         }
       }
 
-      if (conn->server &&
+      if (conn_is_server(conn) &&
           !(conn->dcid.current.flags & NGTCP2_DCID_FLAG_PATH_VALIDATED)) {
         server_tx_left = conn_server_tx_left(conn, &conn->dcid.current);
         origlen = (size_t)ngtcp2_min((uint64_t)origlen, server_tx_left);
         destlen = (size_t)ngtcp2_min((uint64_t)destlen, server_tx_left);
 
-        if (server_tx_left == 0 &&
-            conn->cstat.loss_detection_timer != UINT64_MAX) {
-          ngtcp2_log_info(
-              &conn->log, NGTCP2_LOG_EVENT_RCV,
-              "loss detection timer canceled due to amplification limit");
-          conn->cstat.loss_detection_timer = UINT64_MAX;
+        if (server_tx_left == 0) {
+          conn_amplification_blocked(conn, ts);
+
+          if (conn->cstat.loss_detection_timer != UINT64_MAX) {
+            ngtcp2_log_info(
+                &conn->log, NGTCP2_LOG_EVENT_RCV,
+                "loss detection timer canceled due to amplification limit");
+            conn->cstat.loss_detection_timer = UINT64_MAX;
+          }
         }
       }
     }
@@ -11871,6 +14823,13 @@ ngtcp2_ssize ngtcp2_conn_write_vmsg(ngtcp2_conn *conn, ngtcp2_path *path,
     }
   }
 
+  if (conn->local.settings.handshake_first && conn_is_server(conn) &&
+      !(conn->dcid.current.flags & NGTCP2_DCID_FLAG_PATH_VALIDATED)) {
+    server_tx_left = conn_server_tx_left(conn, &conn->dcid.current);
+    destlen = (size_t)ngtcp2_min(
+        (uint64_t)destlen, conn_server_tx_left_1rtt(conn, server_tx_left));
+  }
+
   if (conn->pktns.rtb.probe_pkt_left) {
     ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_CON,
                     "transmit probe pkt left=%zu",
@@ -11909,6 +14868,35 @@ fin:
   return nwrite;
 }
 
+ngtcp2_ssize ngtcp2_conn_write_vmsg(ngtcp2_conn *conn, ngtcp2_path *path,
+                                    int pkt_info_version, ngtcp2_pkt_info *pi,
+                                    uint8_t *dest, size_t destlen,
+                                    ngtcp2_vmsg *vmsg, ngtcp2_tstamp ts) {
+  ngtcp2_ssize nwrite;
+  ngtcp2_perf_phase perf_phase;
+
+  conn_invalidate_expiry(conn);
+
+  perf_phase = ngtcp2_perf_switch(&conn->perf, NGTCP2_PERF_PHASE_OTHER);
+  nwrite = conn_write_vmsg(conn, path, pkt_info_version, pi, dest, destlen,
+                           vmsg, ts);
+  ngtcp2_perf_switch(&conn->perf, perf_phase);
+
+  /* Initial and Handshake packets always come first in a datagram.
+     A datagram which starts with 0RTT packet carries neither. */
+  if (nwrite > 0 && (dest[0] & NGTCP2_HEADER_FORM_BIT) &&
+      ngtcp2_pkt_get_type_long(conn->negotiated_version
+                                   ? conn->negotiated_version
+                                   : conn->client_chosen_version,
+                               dest[0]) != NGTCP2_PKT_0RTT) {
+    ++conn->cstat.handshake_datagrams_sent;
+  }
+
+  conn_invalidate_expiry(conn);
+
+  return nwrite;
+}
+
 static ngtcp2_ssize
 conn_write_connection_close(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
                             uint8_t *dest, size_t destlen, uint8_t pkt_type,
@@ -11928,7 +14916,7 @@ conn_write_connection_close(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
 
   if (!(conn->flags & NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED) &&
       pkt_type != NGTCP2_PKT_INITIAL) {
-    if (in_pktns && conn->server) {
+    if (in_pktns && conn_is_server(conn)) {
       nwrite = ngtcp2_conn_write_single_frame_pkt(
           conn, pi, dest, destlen, NGTCP2_PKT_INITIAL,
           NGTCP2_WRITE_PKT_FLAG_NONE, &conn->dcid.current.cid, &fr,
@@ -11958,7 +14946,7 @@ conn_write_connection_close(ngtcp2_conn *conn, ngtcp2_pkt_info *pi,
     }
   }
 
-  if (!conn->server && pkt_type == NGTCP2_PKT_INITIAL) {
+  if (!conn_is_server(conn) && pkt_type == NGTCP2_PKT_INITIAL) {
     flags = NGTCP2_WRITE_PKT_FLAG_REQUIRE_PADDING;
   }
 
@@ -11989,6 +14977,8 @@ ngtcp2_ssize ngtcp2_conn_write_connection_close_pkt(
   ngtcp2_ssize nwrite;
   uint64_t server_tx_left;
 
+  conn_invalidate_expiry(conn);
+
   conn->log.last_ts = ts;
   conn->qlog.last_ts = ts;
 
@@ -12016,13 +15006,13 @@ ngtcp2_ssize ngtcp2_conn_write_connection_close_pkt(
     pi->ecn = NGTCP2_ECN_NOT_ECT;
   }
 
-  if (conn->server) {
+  if (conn_is_server(conn)) {
     server_tx_left = conn_server_tx_left(conn, &conn->dcid.current);
     destlen = (size_t)ngtcp2_min((uint64_t)destlen, server_tx_left);
   }
 
   if (conn->state == NGTCP2_CS_POST_HANDSHAKE ||
-      (conn->server && conn->pktns.crypto.tx.ckm)) {
+      (conn_is_server(conn) && conn->pktns.crypto.tx.ckm)) {
     pkt_type = NGTCP2_PKT_1RTT;
   } else if (hs_pktns && hs_pktns->crypto.tx.ckm) {
     pkt_type = NGTCP2_PKT_HANDSHAKE;
@@ -12054,6 +15044,8 @@ ngtcp2_ssize ngtcp2_conn_write_application_close_pkt(
   ngtcp2_frame fr;
   uint64_t server_tx_left;
 
+  conn_invalidate_expiry(conn);
+
   conn->log.last_ts = ts;
   conn->qlog.last_ts = ts;
 
@@ -12081,7 +15073,7 @@ ngtcp2_ssize ngtcp2_conn_write_application_close_pkt(
     pi->ecn = NGTCP2_ECN_NOT_ECT;
   }
 
-  if (conn->server) {
+  if (conn_is_server(conn)) {
     server_tx_left = conn_server_tx_left(conn, &conn->dcid.current);
     destlen = (size_t)ngtcp2_min((uint64_t)destlen, server_tx_left);
   }
@@ -12103,7 +15095,7 @@ ngtcp2_ssize ngtcp2_conn_write_application_close_pkt(
   if (conn->state != NGTCP2_CS_POST_HANDSHAKE) {
     assert(res);
 
-    if (!conn->server || !conn->pktns.crypto.tx.ckm) {
+    if (!conn_is_server(conn) || !conn->pktns.crypto.tx.ckm) {
       return res;
     }
   }
@@ -12205,7 +15197,14 @@ ngtcp2_ssize ngtcp2_conn_write_connection_close_versioned(
     ngtcp2_conn *conn, ngtcp2_path *path, int pkt_info_version,
     ngtcp2_pkt_info *pi, uint8_t *dest, size_t destlen,
     const ngtcp2_connection_close_error *ccerr, ngtcp2_tstamp ts) {
-  (void)pkt_info_version;
+  if (pi && pkt_info_version >= NGTCP2_PKT_INFO_VERSION_V2) {
+    /* CONNECTION_CLOSE is not paced. */
+    pi->tx_ts = ts;
+
+    if (pkt_info_version >= NGTCP2_PKT_INFO_VERSION_V3) {
+      pi->offload_pktlen = 0;
+    }
+  }
 
   switch (ccerr->type) {
   case NGTCP2_CONNECTION_CLOSE_ERROR_CODE_TYPE_TRANSPORT:
@@ -12221,6 +15220,58 @@ ngtcp2_ssize ngtcp2_conn_write_connection_close_versioned(
   }
 }
 
+ngtcp2_ssize ngtcp2_conn_write_keep_alive_versioned(
+    ngtcp2_conn *conn, ngtcp2_path *path, int pkt_info_version,
+    ngtcp2_pkt_info *pi, uint8_t *dest, size_t destlen, ngtcp2_tstamp ts) {
+  ngtcp2_frame fr;
+  ngtcp2_ssize nwrite;
+
+  if (conn->state != NGTCP2_CS_POST_HANDSHAKE ||
+      (conn->flags & NGTCP2_CONN_FLAG_PPE_PENDING)) {
+    return NGTCP2_ERR_INVALID_STATE;
+  }
+
+  if (conn_check_pkt_num_exhausted(conn)) {
+    return NGTCP2_ERR_PKT_NUM_EXHAUSTED;
+  }
+
+  conn->log.last_ts = ts;
+  conn->qlog.last_ts = ts;
+
+  if (path) {
+    ngtcp2_path_copy(path, &conn->dcid.current.ps.path);
+  }
+
+  if (pi) {
+    pi->ecn = NGTCP2_ECN_NOT_ECT;
+
+    if (pkt_info_version >= NGTCP2_PKT_INFO_VERSION_V2) {
+      /* A keep-alive packet is not paced. */
+      pi->tx_ts = ts;
+    }
+
+    if (pkt_info_version >= NGTCP2_PKT_INFO_VERSION_V3) {
+      pi->offload_pktlen = 0;
+    }
+  }
+
+  conn_invalidate_expiry(conn);
+
+  fr.type = NGTCP2_FRAME_PING;
+
+  nwrite = ngtcp2_conn_write_single_frame_pkt(
+      conn, pi, dest, destlen, NGTCP2_PKT_1RTT, NGTCP2_WRITE_PKT_FLAG_NONE,
+      &conn->dcid.current.cid, &fr, NGTCP2_RTB_ENTRY_FLAG_ACK_ELICITING,
+      &conn->dcid.current.ps.path, ts);
+  if (nwrite <= 0) {
+    return nwrite;
+  }
+
+  conn->dcid.current.bytes_sent += (uint64_t)nwrite;
+
+  return nwrite;
+}
+
 int ngtcp2_conn_is_in_closing_period(ngtcp2_conn *conn) {
   return conn->state == NGTCP2_CS_CLOSING;
 }
@@ -12238,13 +15289,28 @@ int ngtcp2_conn_close_stream(ngtcp2_conn *conn, ngtcp2_strm *strm) {
     return rv;
   }
 
+  NGTCP2_PROBE3(stream_close, conn, strm->stream_id, strm->app_error_code);
+
+  conn_release_stream_bufs(conn, strm, ngtcp2_strm_detach_bufs(strm));
+
   rv = conn_call_stream_close(conn, strm);
   if (rv != 0) {
     goto fin;
   }
 
+  if (conn->local.settings.auto_max_streams &&
+      !conn_local_stream(conn, strm->stream_id)) {
+    if (bidi_stream(strm->stream_id)) {
+      handle_max_remote_streams_extension(&conn->remote.bidi.unsent_max_streams,
+                                          1);
+    } else {
+      handle_max_remote_streams_extension(&conn->remote.uni.unsent_max_streams,
+                                          1);
+    }
+  }
+
   if (ngtcp2_strm_is_tx_queued(strm)) {
-    ngtcp2_pq_remove(&conn->tx.strmq, &strm->pe);
+    ngtcp2_conn_tx_strmq_remove(conn, strm);
     if (!ngtcp2_strm_streamfrq_empty(strm)) {
       assert(conn->tx.strmq_nretrans);
       --conn->tx.strmq_nretrans;
@@ -12252,8 +15318,9 @@ int ngtcp2_conn_close_stream(ngtcp2_conn *conn, ngtcp2_strm *strm) {
   }
 
 fin:
+  ngtcp2_sched_remove(&conn->tx.sched, strm);
   ngtcp2_strm_free(strm);
-  ngtcp2_objalloc_strm_release(&conn->strm_objalloc, strm);
+  ngtcp2_objalloc_strm_release(conn->strm_objalloc, strm);
 
   return rv;
 }
@@ -12266,7 +15333,10 @@ int ngtcp2_conn_close_stream_if_shut_rdwr(ngtcp2_conn *conn,
        ngtcp2_strm_rx_offset(strm) == strm->rx.last_offset) &&
       (((strm->flags & NGTCP2_STRM_FLAG_SENT_RST) &&
         (strm->flags & NGTCP2_STRM_FLAG_RST_ACKED)) ||
-       ngtcp2_strm_is_all_tx_data_fin_acked(strm))) {
+       ngtcp2_strm_is_all_tx_data_fin_acked(strm) ||
+       /* A remote unidirectional stream has nothing to send. */
+       (!bidi_stream(strm->stream_id) &&
+        !conn_local_stream(conn, strm->stream_id)))) {
     return ngtcp2_conn_close_stream(conn, strm);
   }
   return 0;
@@ -12378,218 +15448,1461 @@ int ngtcp2_conn_shutdown_stream_read(ngtcp2_conn *conn, int64_t stream_id,
     return 0;
   }
 
-  return conn_shutdown_stream_read(conn, strm, app_error_code);
-}
+  return conn_shutdown_stream_read(conn, strm, app_error_code);
+}
+
+/*
+ * conn_extend_max_stream_offset extends stream level flow control
+ * window by |datalen| of the stream denoted by |strm|.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ */
+static int conn_extend_max_stream_offset(ngtcp2_conn *conn, ngtcp2_strm *strm,
+                                         uint64_t datalen) {
+  ngtcp2_strm *top;
+  int rv;
+
+  if (datalen > NGTCP2_MAX_VARINT ||
+      strm->rx.unsent_max_offset > NGTCP2_MAX_VARINT - datalen) {
+    strm->rx.unsent_max_offset = NGTCP2_MAX_VARINT;
+  } else {
+    strm->rx.unsent_max_offset += datalen;
+  }
+
+  if (!(strm->flags &
+        (NGTCP2_STRM_FLAG_SHUT_RD | NGTCP2_STRM_FLAG_STOP_SENDING)) &&
+      !ngtcp2_strm_is_tx_queued(strm) &&
+      conn_should_send_max_stream_data(conn, strm)) {
+    if (!ngtcp2_conn_tx_strmq_empty(conn)) {
+      top = ngtcp2_conn_tx_strmq_top(conn);
+      strm->cycle = top->cycle;
+    }
+    strm->cycle = conn_tx_strmq_first_cycle(conn);
+    rv = ngtcp2_conn_tx_strmq_push(conn, strm);
+    if (rv != 0) {
+      return rv;
+    }
+
+    conn_update_flow_update_urgency(conn, strm);
+  }
+
+  return 0;
+}
+
+int ngtcp2_conn_attach_stream_buf(ngtcp2_conn *conn, int64_t stream_id,
+                                  uint64_t datalen, void *buf_user_data) {
+  ngtcp2_strm *strm;
+
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
+  if (strm == NULL) {
+    return NGTCP2_ERR_STREAM_NOT_FOUND;
+  }
+
+  return ngtcp2_strm_attach_buf(strm, datalen, buf_user_data);
+}
+
+int ngtcp2_conn_set_stream_sendbuf(ngtcp2_conn *conn, int64_t stream_id,
+                                   size_t maxlen) {
+  ngtcp2_strm *strm;
+
+  if (maxlen == 0) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
+  if (strm == NULL) {
+    return NGTCP2_ERR_STREAM_NOT_FOUND;
+  }
+
+  if (strm->tx.sendbuf || (strm->flags & NGTCP2_STRM_FLAG_SHUT_WR)) {
+    return NGTCP2_ERR_INVALID_STATE;
+  }
+
+  return ngtcp2_strm_sendbuf_init(strm, maxlen);
+}
+
+ngtcp2_ssize ngtcp2_conn_buffer_stream_data(ngtcp2_conn *conn,
+                                            int64_t stream_id, uint32_t flags,
+                                            const uint8_t *data,
+                                            size_t datalen) {
+  ngtcp2_strm *strm;
+
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
+  if (strm == NULL) {
+    return NGTCP2_ERR_STREAM_NOT_FOUND;
+  }
+
+  if (strm->flags & NGTCP2_STRM_FLAG_SHUT_WR) {
+    return NGTCP2_ERR_STREAM_SHUT_WR;
+  }
+
+  if (strm->tx.sendbuf == NULL || strm->tx.sendbuf->fin) {
+    return NGTCP2_ERR_INVALID_STATE;
+  }
+
+  return ngtcp2_strm_sendbuf_write(strm, data, datalen,
+                                   (flags & NGTCP2_WRITE_STREAM_FLAG_FIN) != 0);
+}
+
+void ngtcp2_conn_release_stream_data(ngtcp2_conn *conn, int64_t stream_id,
+                                     uint64_t offset) {
+  ngtcp2_strm *strm;
+
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
+  if (strm == NULL || strm->rx.rob == NULL) {
+    return;
+  }
+
+  ngtcp2_rob_release(strm->rx.rob, offset);
+}
+
+int ngtcp2_conn_set_stream_priority(ngtcp2_conn *conn, int64_t stream_id,
+                                    const ngtcp2_stream_priority *pri) {
+  ngtcp2_strm *strm;
+  int rv;
+
+  if (pri->urgency >= NGTCP2_URGENCY_LEVELS || pri->weight == 0 ||
+      pri->weight > NGTCP2_MAX_STREAM_WEIGHT) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
+  if (strm == NULL) {
+    return NGTCP2_ERR_STREAM_NOT_FOUND;
+  }
+
+  strm->sched.urgency = pri->urgency;
+  strm->sched.incremental = pri->incremental != 0;
+  strm->sched.weight = (uint16_t)pri->weight;
+
+  ngtcp2_sched_reprioritize(&conn->tx.sched, strm);
+
+  /* The order of conn->tx.strmcq does not depend on the priority. */
+  if (ngtcp2_strm_is_tx_queued(strm) && conn_tx_strmq_use_pq(conn)) {
+    /* Removing an entry never shrinks the queue, so that the
+       following push does not fail. */
+    ngtcp2_conn_tx_strmq_remove(conn, strm);
+    rv = ngtcp2_conn_tx_strmq_push(conn, strm);
+
+    assert(0 == rv);
+    (void)rv;
+  }
+
+  return 0;
+}
+
+int ngtcp2_conn_set_stream_fec(ngtcp2_conn *conn, int64_t stream_id,
+                               size_t symbolcnt) {
+  ngtcp2_strm *strm;
+  int rv;
+
+  if (symbolcnt > NGTCP2_MAX_FEC_SYMBOLCNT) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  if (symbolcnt && conn_fec_max_symbollen(conn) == 0) {
+    return NGTCP2_ERR_INVALID_STATE;
+  }
+
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
+  if (strm == NULL) {
+    return NGTCP2_ERR_STREAM_NOT_FOUND;
+  }
+
+  if (strm->tx.fec == NULL) {
+    if (symbolcnt == 0) {
+      return 0;
+    }
+
+    strm->tx.fec = ngtcp2_mem_malloc(conn->mem, sizeof(ngtcp2_fec_enc));
+    if (strm->tx.fec == NULL) {
+      return NGTCP2_ERR_NOMEM;
+    }
+
+    ngtcp2_fec_enc_init(strm->tx.fec, symbolcnt);
+
+    return 0;
+  }
+
+  /* Protect the data which have been added to the current group. */
+  if (strm->tx.fec->symbolcnt &&
+      (symbolcnt == 0 || strm->tx.fec->symbolcnt >= symbolcnt)) {
+    rv = conn_fec_flush(conn, strm);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  if (symbolcnt == 0) {
+    ngtcp2_mem_free(conn->mem, strm->tx.fec);
+    strm->tx.fec = NULL;
+
+    return 0;
+  }
+
+  strm->tx.fec->max_symbolcnt = symbolcnt;
+
+  return 0;
+}
+
+int ngtcp2_conn_schedule_stream(ngtcp2_conn *conn, int64_t stream_id) {
+  ngtcp2_strm *strm;
+
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
+  if (strm == NULL) {
+    return NGTCP2_ERR_STREAM_NOT_FOUND;
+  }
+
+  if (strm->flags & NGTCP2_STRM_FLAG_SHUT_WR) {
+    return NGTCP2_ERR_STREAM_SHUT_WR;
+  }
+
+  return ngtcp2_sched_push(&conn->tx.sched, strm);
+}
+
+void ngtcp2_conn_unschedule_stream(ngtcp2_conn *conn, int64_t stream_id) {
+  ngtcp2_strm *strm;
+
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
+  if (strm == NULL) {
+    return;
+  }
+
+  ngtcp2_sched_remove(&conn->tx.sched, strm);
+}
+
+int64_t ngtcp2_conn_get_scheduled_stream(ngtcp2_conn *conn) {
+  ngtcp2_strm *strm;
+
+  for (;;) {
+    strm = ngtcp2_sched_top(&conn->tx.sched);
+    if (strm == NULL) {
+      return -1;
+    }
+
+    /* The stream might have been reset since it was scheduled. */
+    if (!(strm->flags & NGTCP2_STRM_FLAG_SHUT_WR)) {
+      return strm->stream_id;
+    }
+
+    ngtcp2_sched_remove(&conn->tx.sched, strm);
+  }
+}
+
+int ngtcp2_conn_extend_max_stream_offset(ngtcp2_conn *conn, int64_t stream_id,
+                                         uint64_t datalen) {
+  ngtcp2_strm *strm;
+
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
+  if (strm == NULL) {
+    return 0;
+  }
+
+  return conn_extend_max_stream_offset(conn, strm, datalen);
+}
+
+void ngtcp2_conn_extend_max_offset(ngtcp2_conn *conn, uint64_t datalen) {
+  if (NGTCP2_MAX_VARINT < datalen ||
+      conn->rx.unsent_max_offset > NGTCP2_MAX_VARINT - datalen) {
+    conn->rx.unsent_max_offset = NGTCP2_MAX_VARINT;
+    return;
+  }
+
+  conn->rx.unsent_max_offset += datalen;
+}
+
+void ngtcp2_conn_extend_max_streams_bidi(ngtcp2_conn *conn, size_t n) {
+  handle_max_remote_streams_extension(&conn->remote.bidi.unsent_max_streams, n);
+}
+
+void ngtcp2_conn_extend_max_streams_uni(ngtcp2_conn *conn, size_t n) {
+  handle_max_remote_streams_extension(&conn->remote.uni.unsent_max_streams, n);
+}
+
+const ngtcp2_cid *ngtcp2_conn_get_dcid(ngtcp2_conn *conn) {
+  return &conn->dcid.current.cid;
+}
+
+const ngtcp2_cid *ngtcp2_conn_get_client_initial_dcid(ngtcp2_conn *conn) {
+  return &conn->rcid;
+}
+
+uint32_t ngtcp2_conn_get_client_chosen_version(ngtcp2_conn *conn) {
+  return conn->client_chosen_version;
+}
+
+uint32_t ngtcp2_conn_get_negotiated_version(ngtcp2_conn *conn) {
+  return conn->negotiated_version;
+}
+
+static int delete_strms_pq_each(void *data, void *ptr) {
+  ngtcp2_conn *conn = ptr;
+  ngtcp2_strm *s = data;
+
+  if (ngtcp2_strm_is_tx_queued(s)) {
+    ngtcp2_conn_tx_strmq_remove(conn, s);
+    if (!ngtcp2_strm_streamfrq_empty(s)) {
+      assert(conn->tx.strmq_nretrans);
+      --conn->tx.strmq_nretrans;
+    }
+  }
+
+  ngtcp2_sched_remove(&conn->tx.sched, s);
+  conn_release_stream_bufs(conn, s, ngtcp2_strm_detach_bufs(s));
+  ngtcp2_strm_free(s);
+  ngtcp2_objalloc_strm_release(conn->strm_objalloc, s);
+
+  return 0;
+}
+
+/*
+ * conn_discard_early_data_state discards any connection states which
+ * are altered by any operations during early data transfer.
+ */
+static void conn_discard_early_data_state(ngtcp2_conn *conn) {
+  ngtcp2_frame_chain **pfrc, *frc;
+
+  ngtcp2_rtb_remove_early_data(&conn->pktns.rtb, &conn->cstat);
+
+  ngtcp2_map_each_free(&conn->strms, delete_strms_pq_each, conn);
+  ngtcp2_map_clear(&conn->strms);
+
+  conn->tx.offset = 0;
+
+  conn->rx.unsent_max_offset = conn->rx.max_offset =
+      conn->local.transport_params.initial_max_data;
+
+  conn->remote.bidi.unsent_max_streams = conn->remote.bidi.max_streams =
+      conn->remote.bidi.window =
+          conn->local.transport_params.initial_max_streams_bidi;
+  conn->remote.bidi.blocked = 0;
+
+  conn->remote.uni.unsent_max_streams = conn->remote.uni.max_streams =
+      conn->remote.uni.window =
+          conn->local.transport_params.initial_max_streams_uni;
+  conn->remote.uni.blocked = 0;
+
+  if (conn_is_server(conn)) {
+    conn->local.bidi.next_stream_id = 1;
+    conn->local.uni.next_stream_id = 3;
+  } else {
+    conn->local.bidi.next_stream_id = 0;
+    conn->local.uni.next_stream_id = 2;
+  }
+
+  for (pfrc = &conn->pktns.tx.frq; *pfrc;) {
+    frc = *pfrc;
+    *pfrc = (*pfrc)->next;
+    ngtcp2_frame_chain_objalloc_del(frc, conn->frc_objalloc, conn->mem);
+  }
+}
+
+void ngtcp2_conn_early_data_rejected(ngtcp2_conn *conn) {
+  conn_invalidate_expiry(conn);
+
+  if (conn->flags & NGTCP2_CONN_FLAG_EARLY_DATA_REJECTED) {
+    return;
+  }
+
+  conn->flags |= NGTCP2_CONN_FLAG_EARLY_DATA_REJECTED;
+
+  conn_discard_early_data_state(conn);
+}
+
+int ngtcp2_conn_update_rtt(ngtcp2_conn *conn, ngtcp2_duration rtt,
+                           ngtcp2_duration ack_delay, ngtcp2_tstamp ts) {
+  ngtcp2_conn_stat *cstat = &conn->cstat;
+
+  conn_invalidate_expiry(conn);
+
+  if (cstat->min_rtt == UINT64_MAX) {
+    cstat->latest_rtt = rtt;
+    cstat->min_rtt = rtt;
+    cstat->smoothed_rtt = rtt;
+    cstat->rttvar = rtt / 2;
+    cstat->first_rtt_sample_ts = ts;
+  } else {
+    if (conn->flags & NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED) {
+      assert(conn->remote.transport_params);
+
+      ack_delay =
+          ngtcp2_min(ack_delay, conn->remote.transport_params->max_ack_delay);
+    } else if (ack_delay > 0 && rtt >= cstat->min_rtt &&
+               rtt < cstat->min_rtt + ack_delay) {
+      /* Ignore RTT sample if adjusting ack_delay causes the sample
+         less than min_rtt before handshake confirmation. */
+      ngtcp2_log_info(
+          &conn->log, NGTCP2_LOG_EVENT_RCV,
+          "ignore rtt sample because ack_delay is too large latest_rtt=%" PRIu64
+          " min_rtt=%" PRIu64 " ack_delay=%" PRIu64,
+          rtt / NGTCP2_MILLISECONDS, cstat->min_rtt / NGTCP2_MILLISECONDS,
+          ack_delay / NGTCP2_MILLISECONDS);
+      return NGTCP2_ERR_INVALID_ARGUMENT;
+    }
+
+    cstat->latest_rtt = rtt;
+    cstat->min_rtt = ngtcp2_min(cstat->min_rtt, rtt);
+
+    if (rtt >= cstat->min_rtt + ack_delay) {
+      rtt -= ack_delay;
+    }
+
+    cstat->rttvar = (cstat->rttvar * 3 + (cstat->smoothed_rtt < rtt
+                                              ? rtt - cstat->smoothed_rtt
+                                              : cstat->smoothed_rtt - rtt)) /
+                    4;
+    cstat->smoothed_rtt = (cstat->smoothed_rtt * 7 + rtt) / 8;
+  }
+
+  ngtcp2_log_info(
+      &conn->log, NGTCP2_LOG_EVENT_RCV,
+      "latest_rtt=%" PRIu64 " min_rtt=%" PRIu64 " smoothed_rtt=%" PRIu64
+      " rttvar=%" PRIu64 " ack_delay=%" PRIu64,
+      cstat->latest_rtt / NGTCP2_MILLISECONDS,
+      cstat->min_rtt / NGTCP2_MILLISECONDS,
+      cstat->smoothed_rtt / NGTCP2_MILLISECONDS,
+      cstat->rttvar / NGTCP2_MILLISECONDS, ack_delay / NGTCP2_MILLISECONDS);
+
+  return 0;
+}
+
+void ngtcp2_conn_get_conn_stat_versioned(ngtcp2_conn *conn,
+                                         int conn_stat_version,
+                                         ngtcp2_conn_stat *cstat) {
+  (void)conn_stat_version;
+
+  *cstat = conn->cstat;
+}
+
+int ngtcp2_conn_get_published_conn_stat_versioned(ngtcp2_conn *conn,
+                                                  int conn_stat_version,
+                                                  ngtcp2_conn_stat *cstat) {
+  const ngtcp2_conn_published_stat *published = conn->published;
+  uint32_t seq;
+  (void)conn_stat_version;
+
+  if (!published) {
+    return NGTCP2_ERR_INVALID_STATE;
+  }
+
+  do {
+    seq = ngtcp2_seqlock_read_begin(&published->lock);
+    *cstat = published->cstat;
+  } while (ngtcp2_seqlock_read_retry(&published->lock, seq));
+
+  return 0;
+}
+
+void ngtcp2_conn_get_mem_stat_versioned(ngtcp2_conn *conn,
+                                        int mem_stat_version,
+                                        ngtcp2_mem_stat *mem_stat) {
+  const ngtcp2_mem_acct *acct = &conn->mem_acct;
+  (void)mem_stat_version;
+
+  mem_stat->total = acct->total;
+  mem_stat->peak = acct->peak;
+  mem_stat->ksl = acct->bytes[NGTCP2_MEM_SUBSYS_KSL];
+  mem_stat->rob = acct->bytes[NGTCP2_MEM_SUBSYS_ROB];
+  mem_stat->balloc = acct->bytes[NGTCP2_MEM_SUBSYS_BALLOC];
+  mem_stat->crypto = acct->bytes[NGTCP2_MEM_SUBSYS_CRYPTO];
+  mem_stat->dgram = acct->bytes[NGTCP2_MEM_SUBSYS_DGRAM];
+  mem_stat->other = acct->bytes[NGTCP2_MEM_SUBSYS_OTHER];
+}
+
+void ngtcp2_conn_hibernate(ngtcp2_conn *conn) {
+  ngtcp2_objalloc_shrink(&conn->objalloc.rtb_entry);
+  ngtcp2_objalloc_shrink(&conn->objalloc.frc);
+  ngtcp2_objalloc_shrink(&conn->objalloc.strm);
+
+  ngtcp2_strm_pool_free(&conn->strm_pool, conn->mem);
+  ngtcp2_strm_pool_init(&conn->strm_pool);
+
+  ngtcp2_mem_free(conn->mem, conn->crypto.decrypt_buf.base);
+  conn->crypto.decrypt_buf.base = NULL;
+  conn->crypto.decrypt_buf.len = 0;
+
+  ngtcp2_mem_free(conn->mem, conn->crypto.decrypt_hp_buf.base);
+  conn->crypto.decrypt_hp_buf.base = NULL;
+  conn->crypto.decrypt_hp_buf.len = 0;
+
+  if (conn->protect && conn->protect->len == 0) {
+    ngtcp2_mem_free(conn->mem, conn->protect);
+    conn->protect = NULL;
+  }
+
+  ngtcp2_mem_free(conn->mem, conn->rx_hp);
+  conn->rx_hp = NULL;
+}
+
+/* NGTCP2_SNAPSHOT_MAGIC is the magic number which starts the encoded
+   snapshot of ngtcp2_conn. */
+#define NGTCP2_SNAPSHOT_MAGIC 0x4e47534eu
+/* NGTCP2_SNAPSHOT_V2 is the format version of the encoded snapshot.
+   Version 2 adds the AEAD limits and usage counters. */
+#define NGTCP2_SNAPSHOT_V2 0x02
+/* NGTCP2_SNAPSHOT_STRMLEN is the length of the encoded stream. */
+#define NGTCP2_SNAPSHOT_STRMLEN (8 + 4 + 8 + 2 + 1 + 1 + 8 * 7)
+
+static int strm_snapshot_ready(void *data, void *ptr) {
+  ngtcp2_strm *strm = data;
+  (void)ptr;
+
+  if (!ngtcp2_strm_streamfrq_empty(strm) ||
+      !ngtcp2_strm_is_all_tx_data_acked(strm) || strm->tx.bufs ||
+      strm->tx.fec || strm->rx.fec || ngtcp2_sched_is_queued(strm) ||
+      (!(strm->flags & NGTCP2_STRM_FLAG_SHUT_RD) &&
+       ngtcp2_strm_rx_offset(strm) != strm->rx.last_offset)) {
+    return NGTCP2_ERR_INVALID_STATE;
+  }
+
+  return 0;
+}
+
+/*
+ * conn_snapshot_ready returns 0 if |conn| is in the state that
+ * ngtcp2_conn_encode_snapshot can capture: the handshake is
+ * confirmed, the keys have never been updated, and there is nothing
+ * in flight or queued for transmission which would be lost.
+ */
+static int conn_snapshot_ready(ngtcp2_conn *conn) {
+  ngtcp2_pktns *pktns = &conn->pktns;
+
+  if (conn->state != NGTCP2_CS_POST_HANDSHAKE ||
+      !(conn->flags & NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED) ||
+      (conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_NOT_CONFIRMED) ||
+      conn->crypto.key_update.confirmed_ts != UINT64_MAX ||
+      conn->crypto.key_update.old_rx_ckm || !pktns->crypto.rx.ckm ||
+      !pktns->crypto.tx.ckm ||
+      pktns->crypto.rx.ckm->secret.len > UINT8_MAX ||
+      pktns->crypto.tx.ckm->secret.len > UINT8_MAX ||
+      !ngtcp2_rtb_empty(&pktns->rtb) || pktns->tx.frq ||
+      pktns->crypto.tx.frq.len ||
+      !ngtcp2_conn_tx_strmq_empty(conn) || conn->tx.dgramq ||
+      conn->tx.repairq || conn->pv || conn->pmtud ||
+      ngtcp2_ringbuf_len(&conn->dcid.bound.rb) ||
+      conn->dcid.retire_unacked.len ||
+      ngtcp2_ringbuf_len(&conn->rx.path_challenge.rb)) {
+    return NGTCP2_ERR_INVALID_STATE;
+  }
+
+  return ngtcp2_map_each(&conn->strms, strm_snapshot_ready, NULL);
+}
+
+static size_t snapshot_cidlen(const ngtcp2_cid *cid) {
+  return 1 + cid->datalen;
+}
+
+static uint8_t *snapshot_put_cid(uint8_t *p, const ngtcp2_cid *cid) {
+  *p++ = (uint8_t)cid->datalen;
+  return ngtcp2_cpymem(p, cid->data, cid->datalen);
+}
+
+/*
+ * snapshot_rangeslen returns the length of the ranges which have been
+ * pushed to |gaptr| when they are encoded by snapshot_put_ranges.
+ */
+static size_t snapshot_rangeslen(ngtcp2_gaptr *gaptr) {
+  ngtcp2_ksl_it it;
+  const ngtcp2_range *r;
+  uint64_t begin = 0;
+  size_t n = 0;
+
+  if (ngtcp2_ksl_len(&gaptr->gap) == 0) {
+    return 4;
+  }
+
+  for (it = ngtcp2_ksl_begin(&gaptr->gap); !ngtcp2_ksl_it_end(&it);
+       ngtcp2_ksl_it_next(&it)) {
+    r = ngtcp2_ksl_it_key(&it);
+    if (begin < r->begin) {
+      ++n;
+    }
+    begin = r->end;
+  }
+
+  if (begin != UINT64_MAX) {
+    ++n;
+  }
+
+  return 4 + n * 16;
+}
+
+static uint8_t *snapshot_put_ranges(uint8_t *p, ngtcp2_gaptr *gaptr) {
+  ngtcp2_ksl_it it;
+  const ngtcp2_range *r;
+  uint64_t begin = 0;
+  uint8_t *np = p;
+  uint32_t n = 0;
+
+  p += 4;
+
+  if (ngtcp2_ksl_len(&gaptr->gap)) {
+    for (it = ngtcp2_ksl_begin(&gaptr->gap); !ngtcp2_ksl_it_end(&it);
+         ngtcp2_ksl_it_next(&it)) {
+      r = ngtcp2_ksl_it_key(&it);
+      if (begin < r->begin) {
+        p = ngtcp2_put_uint64be(p, begin);
+        p = ngtcp2_put_uint64be(p, r->begin);
+        ++n;
+      }
+      begin = r->end;
+    }
+
+    if (begin != UINT64_MAX) {
+      p = ngtcp2_put_uint64be(p, begin);
+      p = ngtcp2_put_uint64be(p, UINT64_MAX);
+      ++n;
+    }
+  }
+
+  ngtcp2_put_uint32be(np, n);
+
+  return p;
+}
+
+static int strm_put_snapshot(void *data, void *ptr) {
+  ngtcp2_strm *strm = data;
+  uint8_t **pp = ptr;
+  uint8_t *p = *pp;
+
+  p = ngtcp2_put_uint64be(p, (uint64_t)strm->stream_id);
+  p = ngtcp2_put_uint32be(
+      p, strm->flags & (uint32_t)~(NGTCP2_STRM_FLAG_ACK_BATCHED |
+                                   NGTCP2_STRM_FLAG_FIN_ACK_BATCHED));
+  p = ngtcp2_put_uint64be(p, strm->app_error_code);
+  p = ngtcp2_put_uint16be(p, strm->sched.weight);
+  *p++ = strm->sched.urgency;
+  *p++ = strm->sched.incremental;
+  p = ngtcp2_put_uint64be(p, strm->tx.offset);
+  p = ngtcp2_put_uint64be(p, strm->tx.max_offset);
+  p = ngtcp2_put_uint64be(p, ngtcp2_strm_rx_offset(strm));
+  p = ngtcp2_put_uint64be(p, strm->rx.last_offset);
+  p = ngtcp2_put_uint64be(p, strm->rx.max_offset);
+  p = ngtcp2_put_uint64be(p, strm->rx.unsent_max_offset);
+  p = ngtcp2_put_uint64be(p, strm->rx.window);
+
+  *pp = p;
+
+  return 0;
+}
+
+ngtcp2_ssize ngtcp2_conn_encode_snapshot(ngtcp2_conn *conn, uint8_t *dest,
+                                         size_t destlen) {
+  ngtcp2_pktns *pktns = &conn->pktns;
+  ngtcp2_crypto_km *rx_ckm = pktns->crypto.rx.ckm;
+  ngtcp2_crypto_km *tx_ckm = pktns->crypto.tx.ckm;
+  ngtcp2_transport_params_type exttype =
+      conn_is_server(conn) ? NGTCP2_TRANSPORT_PARAMS_TYPE_CLIENT_HELLO
+                           : NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS;
+  size_t nunused = ngtcp2_ringbuf_len(&conn->dcid.unused.rb);
+  size_t nscid = ngtcp2_ksl_len(&conn->scid.set);
+  size_t len, tplen, i;
+  ngtcp2_ssize nwrite;
+  ngtcp2_dcid *dcid;
+  ngtcp2_scid *scid;
+  ngtcp2_ksl_it it;
+  uint8_t *p = dest;
+  int rv;
+
+  rv = conn_snapshot_ready(conn);
+  if (rv != 0) {
+    return rv;
+  }
+
+  rv = ngtcp2_idtr_sync_gap(&conn->remote.bidi.idtr);
+  if (rv != 0) {
+    return rv;
+  }
+
+  rv = ngtcp2_idtr_sync_gap(&conn->remote.uni.idtr);
+  if (rv != 0) {
+    return rv;
+  }
+
+  nwrite = ngtcp2_encode_transport_params(NULL, 0, exttype,
+                                          conn->remote.transport_params);
+  if (nwrite < 0) {
+    return nwrite;
+  }
+
+  tplen = (size_t)nwrite;
+  if (tplen > UINT16_MAX) {
+    return NGTCP2_ERR_INVALID_STATE;
+  }
+
+  len = 4 + 1 + 1 + 4 + 4 + 8 * 3 + 8 * 2 + 1 + rx_ckm->secret.len + 1 +
+        tx_ckm->secret.len + snapshot_cidlen(&conn->oscid) + 8 +
+        snapshot_cidlen(&conn->dcid.current.cid) + 1 +
+        NGTCP2_STATELESS_RESET_TOKENLEN + 8 + 8 +
+        snapshot_rangeslen(&conn->dcid.seqgap) + 1;
+
+  for (i = 0; i < nunused; ++i) {
+    dcid = ngtcp2_ringbuf_get(&conn->dcid.unused.rb, i);
+    len += 8 + snapshot_cidlen(&dcid->cid) + NGTCP2_STATELESS_RESET_TOKENLEN;
+  }
+
+  len += 8 + 4;
+
+  for (it = ngtcp2_ksl_begin(&conn->scid.set); !ngtcp2_ksl_it_end(&it);
+       ngtcp2_ksl_it_next(&it)) {
+    scid = ngtcp2_ksl_it_get(&it);
+    len += 8 + snapshot_cidlen(&scid->cid) + 1;
+  }
+
+  len += 8 * 4 + snapshot_rangeslen(&pktns->rx.pngap) + 8 * 2 + 8 * 4 + 8 * 4 +
+         snapshot_rangeslen(&conn->remote.bidi.idtr.gap) +
+         snapshot_rangeslen(&conn->remote.uni.idtr.gap) + 8 * 6 + 8 * 5 + 2 +
+         tplen + 4 + NGTCP2_SNAPSHOT_STRMLEN * ngtcp2_map_size(&conn->strms);
+
+  if (destlen < len) {
+    return NGTCP2_ERR_NOBUF;
+  }
+
+  p = ngtcp2_put_uint32be(p, NGTCP2_SNAPSHOT_MAGIC);
+  *p++ = NGTCP2_SNAPSHOT_V2;
+  *p++ = conn_is_server(conn) != 0;
+  p = ngtcp2_put_uint32be(p, conn->negotiated_version);
+  p = ngtcp2_put_uint32be(p, conn->client_chosen_version);
+
+  p = ngtcp2_put_uint64be(p, pktns->crypto.ctx.aead.max_overhead);
+  p = ngtcp2_put_uint64be(p, pktns->crypto.ctx.max_encryption);
+  p = ngtcp2_put_uint64be(p, pktns->crypto.ctx.max_decryption_failure);
+  p = ngtcp2_put_uint64be(p, tx_ckm->use_count);
+  p = ngtcp2_put_uint64be(p, conn->crypto.decryption_failure_count);
+
+  *p++ = (uint8_t)rx_ckm->secret.len;
+  p = ngtcp2_cpymem(p, rx_ckm->secret.base, rx_ckm->secret.len);
+  *p++ = (uint8_t)tx_ckm->secret.len;
+  p = ngtcp2_cpymem(p, tx_ckm->secret.base, tx_ckm->secret.len);
+
+  p = snapshot_put_cid(p, &conn->oscid);
+
+  p = ngtcp2_put_uint64be(p, conn->dcid.current.seq);
+  p = snapshot_put_cid(p, &conn->dcid.current.cid);
+  *p++ = conn->dcid.current.flags;
+  p = ngtcp2_cpymem(p, conn->dcid.current.token,
+                    NGTCP2_STATELESS_RESET_TOKENLEN);
+  p = ngtcp2_put_uint64be(p, conn->dcid.current.max_udp_payload_size);
+  p = ngtcp2_put_uint64be(p, conn->dcid.retire_prior_to);
+  p = snapshot_put_ranges(p, &conn->dcid.seqgap);
+
+  *p++ = (uint8_t)nunused;
+  for (i = 0; i < nunused; ++i) {
+    dcid = ngtcp2_ringbuf_get(&conn->dcid.unused.rb, i);
+    p = ngtcp2_put_uint64be(p, dcid->seq);
+    p = snapshot_put_cid(p, &dcid->cid);
+    p = ngtcp2_cpymem(p, dcid->token, NGTCP2_STATELESS_RESET_TOKENLEN);
+  }
+
+  p = ngtcp2_put_uint64be(p, conn->scid.last_seq);
+  p = ngtcp2_put_uint32be(p, (uint32_t)nscid);
+  for (it = ngtcp2_ksl_begin(&conn->scid.set); !ngtcp2_ksl_it_end(&it);
+       ngtcp2_ksl_it_next(&it)) {
+    scid = ngtcp2_ksl_it_get(&it);
+    p = ngtcp2_put_uint64be(p, scid->seq);
+    p = snapshot_put_cid(p, &scid->cid);
+    *p++ = scid->flags;
+  }
+
+  p = ngtcp2_put_uint64be(p, (uint64_t)pktns->tx.last_pkt_num);
+  p = ngtcp2_put_uint64be(p, (uint64_t)pktns->rx.max_pkt_num);
+  p = ngtcp2_put_uint64be(p, (uint64_t)pktns->rx.max_ack_eliciting_pkt_num);
+  p = ngtcp2_put_uint64be(p, (uint64_t)pktns->rtb.largest_acked_tx_pkt_num);
+  p = snapshot_put_ranges(p, &pktns->rx.pngap);
+  p = ngtcp2_put_uint64be(p, pktns->crypto.tx.offset);
+  p = ngtcp2_put_uint64be(p, ngtcp2_strm_rx_offset(&pktns->crypto.strm));
+
+  p = ngtcp2_put_uint64be(p, conn->local.bidi.max_streams);
+  p = ngtcp2_put_uint64be(p, (uint64_t)conn->local.bidi.next_stream_id);
+  p = ngtcp2_put_uint64be(p, conn->local.uni.max_streams);
+  p = ngtcp2_put_uint64be(p, (uint64_t)conn->local.uni.next_stream_id);
+  p = ngtcp2_put_uint64be(p, conn->remote.bidi.max_streams);
+  p = ngtcp2_put_uint64be(p, conn->remote.bidi.unsent_max_streams);
+  p = snapshot_put_ranges(p, &conn->remote.bidi.idtr.gap);
+  p = ngtcp2_put_uint64be(p, conn->remote.uni.max_streams);
+  p = ngtcp2_put_uint64be(p, conn->remote.uni.unsent_max_streams);
+  p = snapshot_put_ranges(p, &conn->remote.uni.idtr.gap);
+
+  p = ngtcp2_put_uint64be(p, conn->tx.offset);
+  p = ngtcp2_put_uint64be(p, conn->tx.max_offset);
+  p = ngtcp2_put_uint64be(p, conn->rx.offset);
+  p = ngtcp2_put_uint64be(p, conn->rx.max_offset);
+  p = ngtcp2_put_uint64be(p, conn->rx.unsent_max_offset);
+  p = ngtcp2_put_uint64be(p, conn->rx.window);
+
+  p = ngtcp2_put_uint64be(p, conn->cstat.latest_rtt);
+  p = ngtcp2_put_uint64be(p, conn->cstat.min_rtt);
+  p = ngtcp2_put_uint64be(p, conn->cstat.smoothed_rtt);
+  p = ngtcp2_put_uint64be(p, conn->cstat.rttvar);
+  p = ngtcp2_put_uint64be(p, conn->cstat.max_udp_payload_size);
+
+  p = ngtcp2_put_uint16be(p, (uint16_t)tplen);
+  nwrite = ngtcp2_encode_transport_params(p, tplen, exttype,
+                                          conn->remote.transport_params);
+  assert((size_t)nwrite == tplen);
+  p += tplen;
+
+  p = ngtcp2_put_uint32be(p, (uint32_t)ngtcp2_map_size(&conn->strms));
+  rv = ngtcp2_map_each(&conn->strms, strm_put_snapshot, &p);
+  assert(0 == rv);
+
+  assert((size_t)(p - dest) == len);
+
+  return (ngtcp2_ssize)len;
+}
+
+static const uint8_t *snapshot_get_uint64(uint64_t *dest, const uint8_t *p) {
+  *dest = ngtcp2_get_uint64(p);
+  return p + sizeof(uint64_t);
+}
+
+static const uint8_t *snapshot_get_int64(int64_t *dest, const uint8_t *p) {
+  *dest = (int64_t)ngtcp2_get_uint64(p);
+  return p + sizeof(uint64_t);
+}
+
+/*
+ * snapshot_get_vec makes |dest| point to the length prefixed bytes at
+ * |*pp|, and advances |*pp| past them.  It returns
+ * NGTCP2_ERR_INVALID_ARGUMENT if they do not fit in the buffer which
+ * ends at |end|.
+ */
+static int snapshot_get_vec(ngtcp2_vec *dest, const uint8_t **pp,
+                            const uint8_t *end) {
+  const uint8_t *p = *pp;
+
+  if (p == end || (size_t)(end - p - 1) < *p) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  dest->len = *p++;
+  dest->base = (uint8_t *)p;
+  *pp = p + dest->len;
+
+  return 0;
+}
+
+static int snapshot_get_cid(ngtcp2_cid *cid, const uint8_t **pp,
+                            const uint8_t *end) {
+  ngtcp2_vec v;
+  int rv;
+
+  rv = snapshot_get_vec(&v, pp, end);
+  if (rv != 0) {
+    return rv;
+  }
+
+  if (v.len > NGTCP2_MAX_CIDLEN) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  ngtcp2_cid_init(cid, v.base, v.len);
+
+  return 0;
+}
+
+/*
+ * snapshot_get_ranges pushes the ranges encoded at |*pp| to |gaptr|,
+ * and advances |*pp| past them.
+ */
+static int snapshot_get_ranges(ngtcp2_gaptr *gaptr, const uint8_t **pp,
+                               const uint8_t *end) {
+  const uint8_t *p = *pp;
+  uint64_t begin, rend;
+  uint32_t n;
+  int rv;
+
+  if ((size_t)(end - p) < 4) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  n = ngtcp2_get_uint32(p);
+  p += 4;
+
+  if ((size_t)(end - p) / 16 < n) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  for (; n; --n) {
+    p = snapshot_get_uint64(&begin, p);
+    p = snapshot_get_uint64(&rend, p);
+
+    if (begin >= rend) {
+      return NGTCP2_ERR_INVALID_ARGUMENT;
+    }
+
+    rv = ngtcp2_gaptr_push(gaptr, begin, rend - begin);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  *pp = p;
+
+  return 0;
+}
+
+/*
+ * conn_get_snapshot_scids replaces the set of the local connection
+ * IDs of |conn| with the ones encoded at |*pp|.
+ */
+static int conn_get_snapshot_scids(ngtcp2_conn *conn, const uint8_t **pp,
+                                   const uint8_t *end, ngtcp2_tstamp ts) {
+  const uint8_t *p = *pp;
+  ngtcp2_scid *scid;
+  ngtcp2_cid cid;
+  uint64_t seq;
+  uint32_t n;
+  int rv;
+
+  if ((size_t)(end - p) < 8 + 4) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  p = snapshot_get_uint64(&conn->scid.last_seq, p);
+  n = ngtcp2_get_uint32(p);
+  p += 4;
+
+  delete_scid(&conn->scid.set, conn->mem);
+  ngtcp2_ksl_clear(&conn->scid.set);
+  conn->scid.num_retired = 0;
+
+  for (; n; --n) {
+    if ((size_t)(end - p) < 8) {
+      return NGTCP2_ERR_INVALID_ARGUMENT;
+    }
+
+    p = snapshot_get_uint64(&seq, p);
+
+    rv = snapshot_get_cid(&cid, &p, end);
+    if (rv != 0) {
+      return rv;
+    }
+
+    if (p == end || seq > conn->scid.last_seq) {
+      return NGTCP2_ERR_INVALID_ARGUMENT;
+    }
+
+    scid = ngtcp2_mem_malloc(conn->mem, sizeof(*scid));
+    if (scid == NULL) {
+      return NGTCP2_ERR_NOMEM;
+    }
+
+    ngtcp2_scid_init(scid, seq, &cid);
+    scid->flags = *p++ & (NGTCP2_SCID_FLAG_USED | NGTCP2_SCID_FLAG_RETIRED);
+
+    rv = ngtcp2_ksl_insert(&conn->scid.set, NULL, &scid->cid, scid);
+    if (rv != 0) {
+      ngtcp2_mem_free(conn->mem, scid);
+      return rv;
+    }
+
+    if (scid->flags & NGTCP2_SCID_FLAG_RETIRED) {
+      /* The retired connection ID is removed after the grace period
+         which starts over at ts. */
+      scid->retired_ts = ts;
+      ++conn->scid.num_retired;
+    } else if (!(scid->flags & NGTCP2_SCID_FLAG_USED)) {
+      continue;
+    }
+
+    rv = ngtcp2_pq_push(&conn->scid.used, &scid->pe);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  *pp = p;
+
+  return 0;
+}
+
+/*
+ * conn_get_snapshot_strm creates a stream from the state encoded at
+ * |p|.
+ */
+static int conn_get_snapshot_strm(ngtcp2_conn *conn, const uint8_t *p) {
+  ngtcp2_strm *strm;
+  int64_t stream_id;
+  uint64_t rx_offset;
+  int rv;
+
+  p = snapshot_get_int64(&stream_id, p);
+
+  if (stream_id < 0 || stream_id > (int64_t)NGTCP2_MAX_VARINT ||
+      ngtcp2_conn_find_stream(conn, stream_id)) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  strm = ngtcp2_objalloc_strm_get(conn->strm_objalloc);
+  if (strm == NULL) {
+    return NGTCP2_ERR_NOMEM;
+  }
+
+  rv = ngtcp2_conn_init_stream(conn, strm, stream_id, NULL);
+  if (rv != 0) {
+    ngtcp2_objalloc_strm_release(conn->strm_objalloc, strm);
+    return rv;
+  }
+
+  strm->flags = ngtcp2_get_uint32(p);
+  p += 4;
+  p = snapshot_get_uint64(&strm->app_error_code, p);
+  strm->sched.weight = ngtcp2_get_uint16(p);
+  p += 2;
+  strm->sched.urgency = *p++;
+  strm->sched.incremental = *p++;
+  p = snapshot_get_uint64(&strm->tx.offset, p);
+  strm->tx.cont_acked_offset = strm->tx.offset;
+  p = snapshot_get_uint64(&strm->tx.max_offset, p);
+  p = snapshot_get_uint64(&rx_offset, p);
+  strm->rx.cont_offset = rx_offset;
+  p = snapshot_get_uint64(&strm->rx.last_offset, p);
+  p = snapshot_get_uint64(&strm->rx.max_offset, p);
+  p = snapshot_get_uint64(&strm->rx.unsent_max_offset, p);
+  snapshot_get_uint64(&strm->rx.window, p);
+
+  return 0;
+}
+
+int ngtcp2_conn_decode_and_set_snapshot(ngtcp2_conn *conn,
+                                        ngtcp2_vec *rx_secret,
+                                        ngtcp2_vec *tx_secret,
+                                        const uint8_t *data, size_t datalen,
+                                        ngtcp2_tstamp ts) {
+  const uint8_t *p = data, *end = data + datalen;
+  ngtcp2_pktns *pktns = &conn->pktns;
+  ngtcp2_transport_params params;
+  ngtcp2_dcid *dcid;
+  ngtcp2_cid cid;
+  uint64_t seq, rx_offset, max_overhead, max_encryption,
+      max_decryption_failure;
+  size_t len;
+  uint32_t n;
+  int rv;
+
+  if (conn->state != (conn_is_server(conn) ? NGTCP2_CS_SERVER_INITIAL
+                                           : NGTCP2_CS_CLIENT_INITIAL) ||
+      pktns->crypto.rx.ckm || pktns->crypto.tx.ckm ||
+      (conn->in_pktns &&
+       (conn->in_pktns->crypto.rx.ckm || conn->in_pktns->crypto.tx.ckm)) ||
+      (conn->hs_pktns &&
+       (conn->hs_pktns->crypto.rx.ckm || conn->hs_pktns->crypto.tx.ckm)) ||
+      ngtcp2_map_size(&conn->strms)) {
+    return NGTCP2_ERR_INVALID_STATE;
+  }
+
+  if (datalen < 4 + 1 + 1 + 4 + 4 + 8 * 3 + 8 * 2 ||
+      ngtcp2_get_uint32(p) != NGTCP2_SNAPSHOT_MAGIC ||
+      p[4] != NGTCP2_SNAPSHOT_V2 || p[5] != (conn_is_server(conn) != 0)) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  p += 6;
+
+  conn->negotiated_version = ngtcp2_get_uint32(p);
+  p += 4;
+  conn->client_chosen_version = ngtcp2_get_uint32(p);
+  p += 4;
+
+  /* The crypto context set by the application must be the one of the
+     cipher suite negotiated by the original connection. */
+  p = snapshot_get_uint64(&max_overhead, p);
+  p = snapshot_get_uint64(&max_encryption, p);
+  p = snapshot_get_uint64(&max_decryption_failure, p);
+
+  if (max_overhead != pktns->crypto.ctx.aead.max_overhead ||
+      max_encryption != pktns->crypto.ctx.max_encryption ||
+      max_decryption_failure != pktns->crypto.ctx.max_decryption_failure) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  p = snapshot_get_uint64(&conn->crypto.restored_tx_use_count, p);
+  p = snapshot_get_uint64(&conn->crypto.decryption_failure_count, p);
+
+  rv = snapshot_get_vec(rx_secret, &p, end);
+  if (rv != 0) {
+    return rv;
+  }
+
+  rv = snapshot_get_vec(tx_secret, &p, end);
+  if (rv != 0) {
+    return rv;
+  }
+
+  rv = snapshot_get_cid(&conn->oscid, &p, end);
+  if (rv != 0) {
+    return rv;
+  }
+
+  if ((size_t)(end - p) < 8) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  p = snapshot_get_uint64(&conn->dcid.current.seq, p);
+
+  rv = snapshot_get_cid(&conn->dcid.current.cid, &p, end);
+  if (rv != 0) {
+    return rv;
+  }
+
+  if ((size_t)(end - p) < 1 + NGTCP2_STATELESS_RESET_TOKENLEN + 8 + 8) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  conn->dcid.current.flags =
+      *p++ & (NGTCP2_DCID_FLAG_PATH_VALIDATED | NGTCP2_DCID_FLAG_TOKEN_PRESENT);
+  memcpy(conn->dcid.current.token, p, NGTCP2_STATELESS_RESET_TOKENLEN);
+  p += NGTCP2_STATELESS_RESET_TOKENLEN;
+  p = snapshot_get_uint64(&seq, p);
+  conn->dcid.current.max_udp_payload_size = (size_t)seq;
+  p = snapshot_get_uint64(&conn->dcid.retire_prior_to, p);
+
+  rv = snapshot_get_ranges(&conn->dcid.seqgap, &p, end);
+  if (rv != 0) {
+    return rv;
+  }
+
+  if (p == end || *p > NGTCP2_MAX_DCID_POOL_SIZE) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  for (n = *p++; n; --n) {
+    if ((size_t)(end - p) < 8) {
+      return NGTCP2_ERR_INVALID_ARGUMENT;
+    }
+
+    p = snapshot_get_uint64(&seq, p);
+
+    rv = snapshot_get_cid(&cid, &p, end);
+    if (rv != 0) {
+      return rv;
+    }
+
+    if ((size_t)(end - p) < NGTCP2_STATELESS_RESET_TOKENLEN) {
+      return NGTCP2_ERR_INVALID_ARGUMENT;
+    }
+
+    dcid = ngtcp2_ringbuf_push_back(&conn->dcid.unused.rb);
+    ngtcp2_dcid_init(dcid, seq, &cid, p);
+    p += NGTCP2_STATELESS_RESET_TOKENLEN;
+  }
+
+  rv = conn_get_snapshot_scids(conn, &p, end, ts);
+  if (rv != 0) {
+    return rv;
+  }
+
+  if ((size_t)(end - p) < 8 * 4) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  p = snapshot_get_int64(&pktns->tx.last_pkt_num, p);
+  p = snapshot_get_int64(&pktns->rx.max_pkt_num, p);
+  p = snapshot_get_int64(&pktns->rx.max_ack_eliciting_pkt_num, p);
+  p = snapshot_get_int64(&pktns->rtb.largest_acked_tx_pkt_num, p);
+
+  rv = snapshot_get_ranges(&pktns->rx.pngap, &p, end);
+  if (rv != 0) {
+    return rv;
+  }
+
+  if ((size_t)(end - p) < 8 * 2 + 8 * 4 + 8 * 2) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  p = snapshot_get_uint64(&pktns->crypto.tx.offset, p);
+  p = snapshot_get_uint64(&rx_offset, p);
+  pktns->crypto.strm.rx.cont_offset = rx_offset;
+
+  p = snapshot_get_uint64(&conn->local.bidi.max_streams, p);
+  p = snapshot_get_int64(&conn->local.bidi.next_stream_id, p);
+  p = snapshot_get_uint64(&conn->local.uni.max_streams, p);
+  p = snapshot_get_int64(&conn->local.uni.next_stream_id, p);
+  p = snapshot_get_uint64(&conn->remote.bidi.max_streams, p);
+  p = snapshot_get_uint64(&conn->remote.bidi.unsent_max_streams, p);
+
+  rv = snapshot_get_ranges(&conn->remote.bidi.idtr.gap, &p, end);
+  if (rv != 0) {
+    return rv;
+  }
+
+  if ((size_t)(end - p) < 8 * 2) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  p = snapshot_get_uint64(&conn->remote.uni.max_streams, p);
+  p = snapshot_get_uint64(&conn->remote.uni.unsent_max_streams, p);
+
+  rv = snapshot_get_ranges(&conn->remote.uni.idtr.gap, &p, end);
+  if (rv != 0) {
+    return rv;
+  }
+
+  if ((size_t)(end - p) < 8 * 6 + 8 * 5 + 2) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  p = snapshot_get_uint64(&conn->tx.offset, p);
+  p = snapshot_get_uint64(&conn->tx.max_offset, p);
+  p = snapshot_get_uint64(&conn->rx.offset, p);
+  p = snapshot_get_uint64(&conn->rx.max_offset, p);
+  p = snapshot_get_uint64(&conn->rx.unsent_max_offset, p);
+  p = snapshot_get_uint64(&conn->rx.window, p);
+
+  p = snapshot_get_uint64(&conn->cstat.latest_rtt, p);
+  p = snapshot_get_uint64(&conn->cstat.min_rtt, p);
+  p = snapshot_get_uint64(&conn->cstat.smoothed_rtt, p);
+  p = snapshot_get_uint64(&conn->cstat.rttvar, p);
+  p = snapshot_get_uint64(&seq, p);
+  conn->cstat.max_udp_payload_size = (size_t)seq;
+
+  if (conn->cstat.min_rtt != UINT64_MAX) {
+    conn->cstat.first_rtt_sample_ts = ts;
+  }
+
+  len = ngtcp2_get_uint16(p);
+  p += 2;
+
+  if ((size_t)(end - p) < len) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  rv = ngtcp2_decode_transport_params(
+      &params,
+      conn_is_server(conn) ? NGTCP2_TRANSPORT_PARAMS_TYPE_CLIENT_HELLO
+                           : NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS,
+      p, len);
+  if (rv != 0) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  p += len;
+
+  conn_del_remote_transport_params(conn, conn->remote.transport_params);
+  conn->remote.transport_params = NULL;
+
+  rv = conn_copy_remote_transport_params(conn, &conn->remote.transport_params,
+                                         &params);
+  if (rv != 0) {
+    return rv;
+  }
+
+  if ((size_t)(end - p) < 4) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
 
-/*
- * conn_extend_max_stream_offset extends stream level flow control
- * window by |datalen| of the stream denoted by |strm|.
- *
- * This function returns 0 if it succeeds, or one of the following
- * negative error codes:
- *
- * NGTCP2_ERR_NOMEM
- *     Out of memory.
- */
-static int conn_extend_max_stream_offset(ngtcp2_conn *conn, ngtcp2_strm *strm,
-                                         uint64_t datalen) {
-  ngtcp2_strm *top;
+  n = ngtcp2_get_uint32(p);
+  p += 4;
 
-  if (datalen > NGTCP2_MAX_VARINT ||
-      strm->rx.unsent_max_offset > NGTCP2_MAX_VARINT - datalen) {
-    strm->rx.unsent_max_offset = NGTCP2_MAX_VARINT;
-  } else {
-    strm->rx.unsent_max_offset += datalen;
+  if ((size_t)(end - p) / NGTCP2_SNAPSHOT_STRMLEN != n ||
+      (size_t)(end - p) % NGTCP2_SNAPSHOT_STRMLEN) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
   }
 
-  if (!(strm->flags &
-        (NGTCP2_STRM_FLAG_SHUT_RD | NGTCP2_STRM_FLAG_STOP_SENDING)) &&
-      !ngtcp2_strm_is_tx_queued(strm) &&
-      conn_should_send_max_stream_data(conn, strm)) {
-    if (!ngtcp2_pq_empty(&conn->tx.strmq)) {
-      top = ngtcp2_conn_tx_strmq_top(conn);
-      strm->cycle = top->cycle;
+  for (; n; --n, p += NGTCP2_SNAPSHOT_STRMLEN) {
+    rv = conn_get_snapshot_strm(conn, p);
+    if (rv != 0) {
+      return rv;
     }
-    strm->cycle = conn_tx_strmq_first_cycle(conn);
-    return ngtcp2_conn_tx_strmq_push(conn, strm);
   }
 
-  return 0;
-}
+  /* The Initial and Handshake packet number spaces were discarded
+     when the snapshot was taken. */
+  pktns_del(conn->in_pktns, conn->mem);
+  conn->in_pktns = NULL;
+  pktns_del(conn->hs_pktns, conn->mem);
+  conn->hs_pktns = NULL;
 
-int ngtcp2_conn_extend_max_stream_offset(ngtcp2_conn *conn, int64_t stream_id,
-                                         uint64_t datalen) {
-  ngtcp2_strm *strm;
+  conn_free_handshake_only_state(conn);
 
-  strm = ngtcp2_conn_find_stream(conn, stream_id);
-  if (strm == NULL) {
-    return 0;
-  }
+  conn->state = NGTCP2_CS_POST_HANDSHAKE;
+  conn->flags |= NGTCP2_CONN_FLAG_HANDSHAKE_COMPLETED |
+                 NGTCP2_CONN_FLAG_HANDSHAKE_COMPLETED_HANDLED |
+                 NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED |
+                 NGTCP2_CONN_FLAG_CONN_ID_NEGOTIATED |
+                 NGTCP2_CONN_FLAG_TRANSPORT_PARAM_RECVED |
+                 NGTCP2_CONN_FLAG_LOCAL_TRANSPORT_PARAMS_COMMITTED;
+  conn->idle_ts = ts;
+  conn->keep_alive.last_ts = ts;
 
-  return conn_extend_max_stream_offset(conn, strm, datalen);
-}
+  conn_invalidate_expiry(conn);
 
-void ngtcp2_conn_extend_max_offset(ngtcp2_conn *conn, uint64_t datalen) {
-  if (NGTCP2_MAX_VARINT < datalen ||
-      conn->rx.unsent_max_offset > NGTCP2_MAX_VARINT - datalen) {
-    conn->rx.unsent_max_offset = NGTCP2_MAX_VARINT;
-    return;
-  }
+  ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_CON,
+                  "restored from snapshot max_pkt_num=%" PRId64
+                  " last_pkt_num=%" PRId64,
+                  pktns->rx.max_pkt_num, pktns->tx.last_pkt_num);
 
-  conn->rx.unsent_max_offset += datalen;
+  return 0;
 }
 
-void ngtcp2_conn_extend_max_streams_bidi(ngtcp2_conn *conn, size_t n) {
-  handle_max_remote_streams_extension(&conn->remote.bidi.unsent_max_streams, n);
-}
+void ngtcp2_conn_get_perf_stat_versioned(ngtcp2_conn *conn,
+                                         int perf_stat_version,
+                                         ngtcp2_perf_stat *perf_stat) {
+  const uint64_t *ns = conn->perf.ns;
+  (void)perf_stat_version;
 
-void ngtcp2_conn_extend_max_streams_uni(ngtcp2_conn *conn, size_t n) {
-  handle_max_remote_streams_extension(&conn->remote.uni.unsent_max_streams, n);
+  perf_stat->decrypt = ns[NGTCP2_PERF_PHASE_DECRYPT];
+  perf_stat->frame_decode = ns[NGTCP2_PERF_PHASE_FRAME_DECODE];
+  perf_stat->ack = ns[NGTCP2_PERF_PHASE_ACK];
+  perf_stat->loss_detection = ns[NGTCP2_PERF_PHASE_LOSS_DETECTION];
+  perf_stat->cc = ns[NGTCP2_PERF_PHASE_CC];
+  perf_stat->encrypt = ns[NGTCP2_PERF_PHASE_ENCRYPT];
+  perf_stat->other = ns[NGTCP2_PERF_PHASE_OTHER];
 }
 
-const ngtcp2_cid *ngtcp2_conn_get_dcid(ngtcp2_conn *conn) {
-  return &conn->dcid.current.cid;
-}
+void ngtcp2_conn_get_stall_stat_versioned(ngtcp2_conn *conn,
+                                          int stall_stat_version,
+                                          ngtcp2_stall_stat *stall_stat) {
+  const ngtcp2_duration *duration = conn->stall.duration;
+  (void)stall_stat_version;
 
-const ngtcp2_cid *ngtcp2_conn_get_client_initial_dcid(ngtcp2_conn *conn) {
-  return &conn->rcid;
+  stall_stat->cwnd = duration[NGTCP2_STALL_CAUSE_CWND];
+  stall_stat->pacing = duration[NGTCP2_STALL_CAUSE_PACING];
+  stall_stat->conn_flow_control =
+      duration[NGTCP2_STALL_CAUSE_CONN_FLOW_CONTROL];
+  stall_stat->stream_flow_control =
+      duration[NGTCP2_STALL_CAUSE_STREAM_FLOW_CONTROL];
+  stall_stat->app = duration[NGTCP2_STALL_CAUSE_APP];
 }
 
-uint32_t ngtcp2_conn_get_client_chosen_version(ngtcp2_conn *conn) {
-  return conn->client_chosen_version;
+void ngtcp2_conn_get_latency_stat_versioned(ngtcp2_conn *conn,
+                                            int latency_stat_version,
+                                            ngtcp2_latency_stat *latency_stat) {
+  (void)latency_stat_version;
+
+  if (!conn->latency) {
+    memset(latency_stat, 0, sizeof(*latency_stat));
+    return;
+  }
+
+  *latency_stat = *conn->latency;
 }
 
-uint32_t ngtcp2_conn_get_negotiated_version(ngtcp2_conn *conn) {
-  return conn->negotiated_version;
+void ngtcp2_conn_get_hol_stat_versioned(ngtcp2_conn *conn,
+                                        int hol_stat_version,
+                                        ngtcp2_hol_stat *hol_stat) {
+  (void)hol_stat_version;
+
+  *hol_stat = conn->hol;
 }
 
-static int delete_strms_pq_each(void *data, void *ptr) {
-  ngtcp2_conn *conn = ptr;
-  ngtcp2_strm *s = data;
+int ngtcp2_conn_get_stream_hol_stat_versioned(ngtcp2_conn *conn,
+                                              int64_t stream_id,
+                                              int hol_stat_version,
+                                              ngtcp2_hol_stat *hol_stat) {
+  ngtcp2_strm *strm = ngtcp2_conn_find_stream(conn, stream_id);
+  (void)hol_stat_version;
 
-  if (ngtcp2_strm_is_tx_queued(s)) {
-    ngtcp2_pq_remove(&conn->tx.strmq, &s->pe);
-    if (!ngtcp2_strm_streamfrq_empty(s)) {
-      assert(conn->tx.strmq_nretrans);
-      --conn->tx.strmq_nretrans;
-    }
+  if (strm == NULL) {
+    return NGTCP2_ERR_STREAM_NOT_FOUND;
   }
 
-  ngtcp2_strm_free(s);
-  ngtcp2_objalloc_strm_release(&conn->strm_objalloc, s);
+  *hol_stat = strm->rx.hol;
 
   return 0;
 }
 
-/*
- * conn_discard_early_data_state discards any connection states which
- * are altered by any operations during early data transfer.
- */
-static void conn_discard_early_data_state(ngtcp2_conn *conn) {
-  ngtcp2_frame_chain **pfrc, *frc;
+void ngtcp2_conn_get_cc_resume_params(ngtcp2_conn *conn,
+                                      ngtcp2_cc_resume_params *params) {
+  const ngtcp2_conn_stat *cstat = &conn->cstat;
 
-  ngtcp2_rtb_remove_early_data(&conn->pktns.rtb, &conn->cstat);
+  if (cstat->min_rtt == UINT64_MAX) {
+    memset(params, 0, sizeof(*params));
+    return;
+  }
 
-  ngtcp2_map_each_free(&conn->strms, delete_strms_pq_each, conn);
-  ngtcp2_map_clear(&conn->strms);
+  params->min_rtt = cstat->min_rtt;
+  params->max_bw = cstat->delivery_rate_sec;
+  params->cwnd = cstat->cwnd;
+}
 
-  conn->tx.offset = 0;
+/* NGTCP2_CC_RESUME_PARAMS_V1 is the format version of the encoded
+   ngtcp2_cc_resume_params. */
+#define NGTCP2_CC_RESUME_PARAMS_V1 0x01
 
-  conn->rx.unsent_max_offset = conn->rx.max_offset =
-      conn->local.transport_params.initial_max_data;
+ngtcp2_ssize ngtcp2_encode_cc_resume_params(
+    uint8_t *dest, size_t destlen, const ngtcp2_cc_resume_params *params) {
+  uint64_t min_rtt = ngtcp2_min(params->min_rtt, NGTCP2_MAX_VARINT);
+  uint64_t max_bw = ngtcp2_min(params->max_bw, NGTCP2_MAX_VARINT);
+  uint64_t cwnd = ngtcp2_min(params->cwnd, NGTCP2_MAX_VARINT);
+  size_t len = 1 + ngtcp2_put_varint_len(min_rtt) +
+               ngtcp2_put_varint_len(max_bw) + ngtcp2_put_varint_len(cwnd);
+  uint8_t *p;
 
-  conn->remote.bidi.unsent_max_streams = conn->remote.bidi.max_streams =
-      conn->local.transport_params.initial_max_streams_bidi;
+  if (destlen < len) {
+    return NGTCP2_ERR_NOBUF;
+  }
 
-  conn->remote.uni.unsent_max_streams = conn->remote.uni.max_streams =
-      conn->local.transport_params.initial_max_streams_uni;
+  p = dest;
+  *p++ = NGTCP2_CC_RESUME_PARAMS_V1;
+  p = ngtcp2_put_varint(p, min_rtt);
+  p = ngtcp2_put_varint(p, max_bw);
+  p = ngtcp2_put_varint(p, cwnd);
 
-  if (conn->server) {
-    conn->local.bidi.next_stream_id = 1;
-    conn->local.uni.next_stream_id = 3;
-  } else {
-    conn->local.bidi.next_stream_id = 0;
-    conn->local.uni.next_stream_id = 2;
-  }
+  assert((size_t)(p - dest) == len);
 
-  for (pfrc = &conn->pktns.tx.frq; *pfrc;) {
-    frc = *pfrc;
-    *pfrc = (*pfrc)->next;
-    ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
-  }
+  return (ngtcp2_ssize)len;
 }
 
-void ngtcp2_conn_early_data_rejected(ngtcp2_conn *conn) {
-  if (conn->flags & NGTCP2_CONN_FLAG_EARLY_DATA_REJECTED) {
-    return;
-  }
-
-  conn->flags |= NGTCP2_CONN_FLAG_EARLY_DATA_REJECTED;
+int ngtcp2_decode_cc_resume_params(ngtcp2_cc_resume_params *params,
+                                   const uint8_t *data, size_t datalen) {
+  uint64_t v[3];
+  ngtcp2_ssize nread;
 
-  conn_discard_early_data_state(conn);
-}
+  if (datalen == 0 || data[0] != NGTCP2_CC_RESUME_PARAMS_V1) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
 
-int ngtcp2_conn_update_rtt(ngtcp2_conn *conn, ngtcp2_duration rtt,
-                           ngtcp2_duration ack_delay, ngtcp2_tstamp ts) {
-  ngtcp2_conn_stat *cstat = &conn->cstat;
+  nread = ngtcp2_get_varints(v, sizeof(v) / sizeof(v[0]), data + 1,
+                             datalen - 1);
+  if (nread < 0 || (size_t)nread != datalen - 1) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
 
-  if (cstat->min_rtt == UINT64_MAX) {
-    cstat->latest_rtt = rtt;
-    cstat->min_rtt = rtt;
-    cstat->smoothed_rtt = rtt;
-    cstat->rttvar = rtt / 2;
-    cstat->first_rtt_sample_ts = ts;
-  } else {
-    if (conn->flags & NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED) {
-      assert(conn->remote.transport_params);
+  params->min_rtt = v[0];
+  params->max_bw = v[1];
+  params->cwnd = v[2];
 
-      ack_delay =
-          ngtcp2_min(ack_delay, conn->remote.transport_params->max_ack_delay);
-    } else if (ack_delay > 0 && rtt >= cstat->min_rtt &&
-               rtt < cstat->min_rtt + ack_delay) {
-      /* Ignore RTT sample if adjusting ack_delay causes the sample
-         less than min_rtt before handshake confirmation. */
-      ngtcp2_log_info(
-          &conn->log, NGTCP2_LOG_EVENT_RCV,
-          "ignore rtt sample because ack_delay is too large latest_rtt=%" PRIu64
-          " min_rtt=%" PRIu64 " ack_delay=%" PRIu64,
-          rtt / NGTCP2_MILLISECONDS, cstat->min_rtt / NGTCP2_MILLISECONDS,
-          ack_delay / NGTCP2_MILLISECONDS);
-      return NGTCP2_ERR_INVALID_ARGUMENT;
-    }
+  return 0;
+}
 
-    cstat->latest_rtt = rtt;
-    cstat->min_rtt = ngtcp2_min(cstat->min_rtt, rtt);
+int ngtcp2_conn_set_cc_callbacks_versioned(
+    ngtcp2_conn *conn, int cc_callbacks_version,
+    const ngtcp2_cc_callbacks *cc_callbacks) {
+  ngtcp2_cc cc;
+  int rv;
+  (void)cc_callbacks_version;
 
-    if (rtt >= cstat->min_rtt + ack_delay) {
-      rtt -= ack_delay;
-    }
+  if (conn->pktns.tx.last_pkt_num != -1 ||
+      (conn->in_pktns && conn->in_pktns->tx.last_pkt_num != -1) ||
+      (conn->hs_pktns && conn->hs_pktns->tx.last_pkt_num != -1)) {
+    return NGTCP2_ERR_INVALID_STATE;
+  }
 
-    cstat->rttvar = (cstat->rttvar * 3 + (cstat->smoothed_rtt < rtt
-                                              ? rtt - cstat->smoothed_rtt
-                                              : cstat->smoothed_rtt - rtt)) /
-                    4;
-    cstat->smoothed_rtt = (cstat->smoothed_rtt * 7 + rtt) / 8;
+  rv = ngtcp2_cc_user_cc_init(&cc, &conn->log, conn, &conn->rst,
+                              cc_callbacks, conn->mem);
+  if (rv != 0) {
+    return rv;
   }
 
-  ngtcp2_log_info(
-      &conn->log, NGTCP2_LOG_EVENT_RCV,
-      "latest_rtt=%" PRIu64 " min_rtt=%" PRIu64 " smoothed_rtt=%" PRIu64
-      " rttvar=%" PRIu64 " ack_delay=%" PRIu64,
-      cstat->latest_rtt / NGTCP2_MILLISECONDS,
-      cstat->min_rtt / NGTCP2_MILLISECONDS,
-      cstat->smoothed_rtt / NGTCP2_MILLISECONDS,
-      cstat->rttvar / NGTCP2_MILLISECONDS, ack_delay / NGTCP2_MILLISECONDS);
+  if (conn->flags & NGTCP2_CONN_FLAG_USER_CC) {
+    ngtcp2_cc_user_cc_free(&conn->cc, conn->mem);
+  } else {
+    cc_del(&conn->cc, conn->cc_algo, conn->mem);
+  }
 
-  return 0;
-}
+  conn->cc = cc;
+  conn->flags |= NGTCP2_CONN_FLAG_USER_CC;
+  conn->cc_resume.phase = NGTCP2_CC_RESUME_PHASE_NONE;
 
-void ngtcp2_conn_get_conn_stat_versioned(ngtcp2_conn *conn,
-                                         int conn_stat_version,
-                                         ngtcp2_conn_stat *cstat) {
-  (void)conn_stat_version;
+  conn->cc.reset(&conn->cc, &conn->cstat, conn->local.settings.initial_ts);
 
-  *cstat = conn->cstat;
+  return 0;
 }
 
 static void conn_get_loss_time_and_pktns(ngtcp2_conn *conn,
@@ -12667,6 +16980,8 @@ void ngtcp2_conn_set_loss_detection_timer(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
   ngtcp2_pktns *pktns = &conn->pktns;
   ngtcp2_tstamp earliest_loss_time;
 
+  conn_invalidate_expiry(conn);
+
   conn_get_loss_time_and_pktns(conn, &earliest_loss_time, NULL);
 
   if (earliest_loss_time != UINT64_MAX) {
@@ -12682,7 +16997,7 @@ void ngtcp2_conn_set_loss_detection_timer(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
       (!hs_pktns || hs_pktns->rtb.num_pto_eliciting == 0) &&
       (pktns->rtb.num_pto_eliciting == 0 ||
        !(conn->flags & NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED)) &&
-      (conn->server ||
+      (conn_is_server(conn) ||
        (conn->flags & (NGTCP2_CONN_FLAG_SERVER_ADDR_VERIFIED |
                        NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED)))) {
     if (cstat->loss_detection_timer != UINT64_MAX) {
@@ -12712,6 +17027,8 @@ int ngtcp2_conn_on_loss_detection_timer(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
   ngtcp2_tstamp earliest_loss_time;
   ngtcp2_pktns *loss_pktns = NULL;
 
+  conn_invalidate_expiry(conn);
+
   conn->log.last_ts = ts;
   conn->qlog.last_ts = ts;
 
@@ -12745,7 +17062,7 @@ int ngtcp2_conn_on_loss_detection_timer(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
     return 0;
   }
 
-  if (!conn->server && !conn_is_handshake_completed(conn)) {
+  if (!conn_is_server(conn) && !conn_is_handshake_completed(conn)) {
     if (hs_pktns->crypto.tx.ckm) {
       hs_pktns->rtb.probe_pkt_left = 1;
     } else {
@@ -12757,7 +17074,7 @@ int ngtcp2_conn_on_loss_detection_timer(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
 
       assert(hs_pktns);
 
-      if (conn->server && hs_pktns->rtb.num_pto_eliciting) {
+      if (conn_is_server(conn) && hs_pktns->rtb.num_pto_eliciting) {
         /* let server coalesce packets */
         hs_pktns->rtb.probe_pkt_left = 1;
       }
@@ -12770,6 +17087,8 @@ int ngtcp2_conn_on_loss_detection_timer(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
 
   ++cstat->pto_count;
 
+  NGTCP2_PROBE2(pto, conn, cstat->pto_count);
+
   ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_RCV, "pto_count=%zu",
                   cstat->pto_count);
 
@@ -12794,7 +17113,9 @@ static int conn_buffer_crypto_data(ngtcp2_conn *conn, const uint8_t **pdata,
   }
 
   if (!*pbufchain) {
-    rv = ngtcp2_buf_chain_new(pbufchain, ngtcp2_max(1024, datalen), conn->mem);
+    rv = ngtcp2_buf_chain_new(
+        pbufchain, ngtcp2_max(1024, datalen),
+        ngtcp2_mem_for_subsys(conn->mem, NGTCP2_MEM_SUBSYS_CRYPTO));
     if (rv != 0) {
       return rv;
     }
@@ -12839,7 +17160,7 @@ int ngtcp2_conn_submit_crypto_data(ngtcp2_conn *conn,
     return rv;
   }
 
-  rv = ngtcp2_frame_chain_objalloc_new(&frc, &conn->frc_objalloc);
+  rv = ngtcp2_frame_chain_objalloc_new(&frc, conn->frc_objalloc);
   if (rv != 0) {
     return rv;
   }
@@ -12852,11 +17173,7 @@ int ngtcp2_conn_submit_crypto_data(ngtcp2_conn *conn,
   fr->data[0].len = datalen;
   fr->data[0].base = (uint8_t *)data;
 
-  rv = ngtcp2_ksl_insert(&pktns->crypto.tx.frq, NULL, &fr->offset, frc);
-  if (rv != 0) {
-    ngtcp2_frame_chain_objalloc_del(frc, &conn->frc_objalloc, conn->mem);
-    return rv;
-  }
+  ngtcp2_cryptofrq_push(&pktns->crypto.tx.frq, frc);
 
   pktns->crypto.strm.tx.offset += datalen;
   pktns->crypto.tx.offset += datalen;
@@ -12875,7 +17192,7 @@ int ngtcp2_conn_submit_new_token(ngtcp2_conn *conn, const uint8_t *token,
   assert(tokenlen);
 
   rv = ngtcp2_frame_chain_new_token_objalloc_new(
-      &nfrc, &tokenv, &conn->frc_objalloc, conn->mem);
+      &nfrc, &tokenv, conn->frc_objalloc, conn->mem);
   if (rv != 0) {
     return rv;
   }
@@ -12887,23 +17204,55 @@ int ngtcp2_conn_submit_new_token(ngtcp2_conn *conn, const uint8_t *token,
 }
 
 ngtcp2_strm *ngtcp2_conn_tx_strmq_top(ngtcp2_conn *conn) {
-  assert(!ngtcp2_pq_empty(&conn->tx.strmq));
-  return ngtcp2_struct_of(ngtcp2_pq_top(&conn->tx.strmq), ngtcp2_strm, pe);
+  assert(!ngtcp2_conn_tx_strmq_empty(conn));
+
+  if (conn_tx_strmq_use_pq(conn)) {
+    return ngtcp2_struct_of(ngtcp2_pq_top(&conn->tx.strmq), ngtcp2_strm, pe);
+  }
+
+  return ngtcp2_struct_of(ngtcp2_cycleq_top(&conn->tx.strmcq), ngtcp2_strm,
+                          pe);
 }
 
 void ngtcp2_conn_tx_strmq_pop(ngtcp2_conn *conn) {
   ngtcp2_strm *strm = ngtcp2_conn_tx_strmq_top(conn);
   assert(strm);
-  ngtcp2_pq_pop(&conn->tx.strmq);
+
+  if (conn_tx_strmq_use_pq(conn)) {
+    ngtcp2_pq_pop(&conn->tx.strmq);
+  } else {
+    ngtcp2_cycleq_pop(&conn->tx.strmcq);
+  }
+
   strm->pe.index = NGTCP2_PQ_BAD_INDEX;
 }
 
 int ngtcp2_conn_tx_strmq_push(ngtcp2_conn *conn, ngtcp2_strm *strm) {
-  return ngtcp2_pq_push(&conn->tx.strmq, &strm->pe);
+  if (conn_tx_strmq_use_pq(conn)) {
+    return ngtcp2_pq_push(&conn->tx.strmq, &strm->pe);
+  }
+
+  return ngtcp2_cycleq_push(&conn->tx.strmcq, &strm->pe);
+}
+
+void ngtcp2_conn_tx_strmq_remove(ngtcp2_conn *conn, ngtcp2_strm *strm) {
+  if (conn_tx_strmq_use_pq(conn)) {
+    ngtcp2_pq_remove(&conn->tx.strmq, &strm->pe);
+  } else {
+    ngtcp2_cycleq_remove(&conn->tx.strmcq, &strm->pe);
+  }
+}
+
+int ngtcp2_conn_tx_strmq_empty(ngtcp2_conn *conn) {
+  if (conn_tx_strmq_use_pq(conn)) {
+    return ngtcp2_pq_empty(&conn->tx.strmq);
+  }
+
+  return ngtcp2_cycleq_empty(&conn->tx.strmcq);
 }
 
 static int conn_has_uncommited_preferred_address_cid(ngtcp2_conn *conn) {
-  return conn->server &&
+  return conn_is_server(conn) &&
          !(conn->flags & NGTCP2_CONN_FLAG_LOCAL_TRANSPORT_PARAMS_COMMITTED) &&
          conn->oscid.datalen &&
          conn->local.transport_params.preferred_address_present;
@@ -13019,6 +17368,72 @@ const ngtcp2_path *ngtcp2_conn_get_path(ngtcp2_conn *conn) {
   return &conn->dcid.current.ps.path;
 }
 
+/*
+ * conn_get_path_stat assigns the statistics of the path associated
+ * to |dcid| to |pstat|.  RTT is taken from |dcid|.
+ */
+static void conn_get_path_stat(ngtcp2_conn *conn, const ngtcp2_dcid *dcid,
+                               ngtcp2_path_stat *pstat) {
+  ngtcp2_pv *pv = conn->pv;
+
+  pstat->path = dcid->ps.path;
+  pstat->latest_rtt = dcid->latest_rtt;
+  pstat->min_rtt = dcid->min_rtt;
+  pstat->smoothed_rtt = dcid->smoothed_rtt;
+  pstat->lost_pkt_count = dcid->lost_pkt_count;
+  pstat->bytes_sent = dcid->bytes_sent;
+  pstat->bytes_recv = dcid->bytes_recv;
+  pstat->max_udp_payload_size = dcid->max_udp_payload_size;
+  pstat->validated_ts = dcid->validated_ts;
+  pstat->validated = (dcid->flags & NGTCP2_DCID_FLAG_PATH_VALIDATED) != 0;
+
+  if (pv && ngtcp2_path_eq(&pv->dcid.ps.path, &dcid->ps.path)) {
+    pstat->validation_start_ts = pv->started_ts;
+  } else {
+    pstat->validation_start_ts = UINT64_MAX;
+  }
+}
+
+int ngtcp2_conn_get_path_stat_versioned(ngtcp2_conn *conn,
+                                        ngtcp2_path_role role,
+                                        int path_stat_version,
+                                        ngtcp2_path_stat *pstat) {
+  ngtcp2_pv *pv = conn->pv;
+  const ngtcp2_conn_stat *cstat = &conn->cstat;
+  (void)path_stat_version;
+
+  switch (role) {
+  case NGTCP2_PATH_ROLE_ACTIVE:
+    conn_get_path_stat(conn, &conn->dcid.current, pstat);
+
+    if (cstat->min_rtt != UINT64_MAX) {
+      pstat->latest_rtt = cstat->latest_rtt;
+      pstat->min_rtt = cstat->min_rtt;
+      pstat->smoothed_rtt = cstat->smoothed_rtt;
+    }
+
+    return 0;
+  case NGTCP2_PATH_ROLE_FALLBACK:
+    if (!pv || !(pv->flags & NGTCP2_PV_FLAG_FALLBACK_ON_FAILURE)) {
+      return NGTCP2_ERR_INVALID_ARGUMENT;
+    }
+
+    conn_get_path_stat(conn, &pv->fallback_dcid, pstat);
+
+    return 0;
+  case NGTCP2_PATH_ROLE_PROBING:
+    if (!pv) {
+      return NGTCP2_ERR_INVALID_ARGUMENT;
+    }
+
+    conn_get_path_stat(conn, &pv->dcid, pstat);
+
+    return 0;
+  default:
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+}
+
 size_t ngtcp2_conn_get_max_udp_payload_size(ngtcp2_conn *conn) {
   return conn->local.settings.max_udp_payload_size;
 }
@@ -13057,6 +17472,8 @@ int ngtcp2_conn_initiate_immediate_migration(ngtcp2_conn *conn,
   int rv;
   ngtcp2_dcid *dcid;
 
+  conn_invalidate_expiry(conn);
+
   assert(!conn->server);
 
   conn->log.last_ts = ts;
@@ -13112,6 +17529,8 @@ int ngtcp2_conn_initiate_migration(ngtcp2_conn *conn, const ngtcp2_path *path,
   ngtcp2_duration pto, initial_pto, timeout;
   ngtcp2_pv *pv;
 
+  conn_invalidate_expiry(conn);
+
   assert(!conn->server);
 
   conn->log.last_ts = ts;
@@ -13300,7 +17719,7 @@ int ngtcp2_conn_is_local_stream(ngtcp2_conn *conn, int64_t stream_id) {
   return conn_local_stream(conn, stream_id);
 }
 
-int ngtcp2_conn_is_server(ngtcp2_conn *conn) { return conn->server; }
+int ngtcp2_conn_is_server(ngtcp2_conn *conn) { return conn_is_server(conn); }
 
 int ngtcp2_conn_after_retry(ngtcp2_conn *conn) {
   return (conn->flags & NGTCP2_CONN_FLAG_RECV_RETRY) != 0;
@@ -13320,16 +17739,34 @@ int ngtcp2_conn_set_stream_user_data(ngtcp2_conn *conn, int64_t stream_id,
 }
 
 void ngtcp2_conn_update_pkt_tx_time(ngtcp2_conn *conn, ngtcp2_tstamp ts) {
+  conn_invalidate_expiry(conn);
+
   if (!(conn->cstat.pacing_rate > 0) || conn->tx.pacing.pktlen == 0) {
     return;
   }
 
+  if (conn->local.settings.pacing_horizon) {
+    /* The packets just written leave the host at departure_ts which
+       might be in the future. */
+    ts = ngtcp2_max(ts, conn->tx.pacing.departure_ts);
+  }
+
   conn->tx.pacing.next_ts =
       ts + (ngtcp2_duration)((double)conn->tx.pacing.pktlen /
                              conn->cstat.pacing_rate);
+  conn->tx.pacing.departure_ts = conn->tx.pacing.next_ts;
   conn->tx.pacing.pktlen = 0;
 }
 
+ngtcp2_tstamp ngtcp2_conn_get_pkt_tx_time(ngtcp2_conn *conn,
+                                          ngtcp2_tstamp ts) {
+  if (!conn->local.settings.pacing_horizon || !(conn->cstat.pacing_rate > 0)) {
+    return ts;
+  }
+
+  return ngtcp2_max(ts, conn->tx.pacing.departure_ts);
+}
+
 size_t ngtcp2_conn_get_send_quantum(ngtcp2_conn *conn) {
   return conn->cstat.send_quantum;
 }
@@ -13401,6 +17838,7 @@ void ngtcp2_settings_default_versioned(int settings_version,
   settings->ack_thresh = 2;
   settings->max_udp_payload_size = 1500 - 48;
   settings->handshake_timeout = NGTCP2_DEFAULT_HANDSHAKE_TIMEOUT;
+  settings->hystart = 1;
 }
 
 void ngtcp2_transport_params_default_versioned(
@@ -13449,6 +17887,8 @@ ngtcp2_ssize ngtcp2_pkt_write_connection_close(
   cc.hp_ctx = *hp_ctx;
   cc.encrypt = encrypt;
   cc.hp_mask = hp_mask;
+  cc.encrypt_hp_mask = NULL;
+  cc.encrypt_vec = NULL;
 
   ngtcp2_ppe_init(&ppe, dest, destlen, &cc);
 
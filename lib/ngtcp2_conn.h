@@ -41,6 +41,7 @@
 #include "ngtcp2_pkt.h"
 #include "ngtcp2_log.h"
 #include "ngtcp2_pq.h"
+#include "ngtcp2_cycleq.h"
 #include "ngtcp2_cc.h"
 #include "ngtcp2_bbr.h"
 #include "ngtcp2_bbr2.h"
@@ -51,6 +52,11 @@
 #include "ngtcp2_ppe.h"
 #include "ngtcp2_qlog.h"
 #include "ngtcp2_rst.h"
+#include "ngtcp2_sched.h"
+#include "ngtcp2_perf.h"
+#include "ngtcp2_latency.h"
+#include "ngtcp2_stall.h"
+#include "ngtcp2_seqlock.h"
 
 typedef enum {
   /* Client specific handshake states */
@@ -70,9 +76,11 @@ typedef enum {
 /* NGTCP2_MAX_STREAMS is the maximum number of streams. */
 #define NGTCP2_MAX_STREAMS (1LL << 60)
 
-/* NGTCP2_MAX_NUM_BUFFED_RX_PKTS is the maximum number of buffered
-   reordered packets. */
-#define NGTCP2_MAX_NUM_BUFFED_RX_PKTS 4
+/* NGTCP2_BUFFED_RX_PKTS_BUFLEN is the size of the buffer per packet
+   number space which stores the reordered packets that cannot be
+   decrypted yet.  It holds 4 packets of the maximum UDP payload size
+   plus their metadata. */
+#define NGTCP2_BUFFED_RX_PKTS_BUFLEN 8192
 
 /* NGTCP2_MAX_REORDERED_CRYPTO_DATA is the maximum offset of crypto
    data which is not continuous.  In other words, there is a gap of
@@ -115,6 +123,10 @@ typedef enum {
    ACK-eliciting packets. */
 #define NGTCP2_MAX_NON_ACK_TX_PKT 3
 
+/* NGTCP2_MAX_ACK_ELICITING_THRESHOLD is the maximum Ack-Eliciting
+   Threshold that local endpoint requests in ACK_FREQUENCY frame. */
+#define NGTCP2_MAX_ACK_ELICITING_THRESHOLD 32
+
 /* NGTCP2_ECN_MAX_NUM_VALIDATION_PKTS is the maximum number of ECN marked
    packets sent in NGTCP2_ECN_STATE_TESTING period. */
 #define NGTCP2_ECN_MAX_NUM_VALIDATION_PKTS 10
@@ -124,6 +136,33 @@ typedef enum {
    longer than this value, it is truncated. */
 #define NGTCP2_CONNECTION_CLOSE_ERROR_MAX_REASONLEN 1024
 
+/* NGTCP2_MAX_DEFERRED_PKTS is the maximum number of 1RTT packets
+   whose protection is deferred.  If it is exceeded, the pending
+   packets are protected before a new packet is written. */
+#define NGTCP2_MAX_DEFERRED_PKTS NGTCP2_PPE_MAX_BATCH
+
+/* NGTCP2_MAX_RX_HP_MASKS is the maximum number of header protection
+   masks that ngtcp2_conn_prepare_rx_hp_masks precomputes. */
+#ifndef LOWMEMORY
+#  define NGTCP2_MAX_RX_HP_MASKS 64
+#else /* LOWMEMORY */
+#  define NGTCP2_MAX_RX_HP_MASKS 8
+#endif /* LOWMEMORY */
+
+/* NGTCP2_CONN_OBJALLOC_NMEMB is the number of objects which a block
+   of the object pools of ngtcp2_conn, e.g., frc_objalloc, holds. */
+#ifndef LOWMEMORY
+#  define NGTCP2_CONN_OBJALLOC_NMEMB 64
+#else /* LOWMEMORY */
+#  define NGTCP2_CONN_OBJALLOC_NMEMB 4
+#endif /* LOWMEMORY */
+
+/* NGTCP2_PMTUD_BLACK_HOLE_THRESHOLD is the number of lost 1RTT
+   packets larger than NGTCP2_MAX_UDP_PAYLOAD_SIZE, which are sent
+   after the last acknowledged one of such packets, that makes the
+   local endpoint conclude that the path drops them. */
+#define NGTCP2_PMTUD_BLACK_HOLE_THRESHOLD 3
+
 /* NGTCP2_WRITE_PKT_FLAG_NONE indicates that no flag is set. */
 #define NGTCP2_WRITE_PKT_FLAG_NONE 0x00u
 /* NGTCP2_WRITE_PKT_FLAG_REQUIRE_PADDING indicates that packet other
@@ -133,6 +172,13 @@ typedef enum {
 /* NGTCP2_WRITE_PKT_FLAG_MORE indicates that more frames might come
    and it should be encoded into the current packet. */
 #define NGTCP2_WRITE_PKT_FLAG_MORE 0x02u
+/* NGTCP2_WRITE_PKT_FLAG_CRYPTO_OFFLOAD indicates that 1RTT packet is
+   left unprotected, and it is described in ngtcp2_pkt_info. */
+#define NGTCP2_WRITE_PKT_FLAG_CRYPTO_OFFLOAD 0x04u
+/* NGTCP2_WRITE_PKT_FLAG_PMTUD_PROBE indicates that 1RTT packet is a
+   PMTUD probe.  It is padded to the given buffer length, and it is
+   made ack-eliciting. */
+#define NGTCP2_WRITE_PKT_FLAG_PMTUD_PROBE 0x08u
 
 /*
  * ngtcp2_max_frame is defined so that it covers the largest ACK
@@ -156,6 +202,25 @@ void ngtcp2_path_challenge_entry_init(ngtcp2_path_challenge_entry *pcent,
                                       const ngtcp2_path *path,
                                       const uint8_t *data);
 
+/* ngtcp2_dgram_entry is a DATAGRAM queued by
+   ngtcp2_conn_enqueue_datagram.  The data is owned by application. */
+typedef struct ngtcp2_dgram_entry {
+  struct ngtcp2_dgram_entry *next;
+  /* dgram_id is the identifier passed to ngtcp2_ack_datagram and
+     ngtcp2_lost_datagram callbacks. */
+  uint64_t dgram_id;
+  /* expiry is the deadline after which the datagram is dropped
+     instead of being sent.  UINT64_MAX means no deadline. */
+  ngtcp2_tstamp expiry;
+  /* datalen is the sum of the length of data. */
+  size_t datalen;
+  /* datacnt is the number of elements that data contains. */
+  size_t datacnt;
+  /* data points to the array of ngtcp2_vec allocated right after
+     this object. */
+  ngtcp2_vec *data;
+} ngtcp2_dgram_entry;
+
 /* NGTCP2_CONN_FLAG_NONE indicates that no flag is set. */
 #define NGTCP2_CONN_FLAG_NONE 0x00u
 /* NGTCP2_CONN_FLAG_HANDSHAKE_COMPLETED is set when TLS stack declares
@@ -220,6 +285,49 @@ void ngtcp2_path_challenge_entry_init(ngtcp2_path_challenge_entry *pcent,
 /* NGTCP2_CONN_FLAG_KEY_UPDATE_INITIATOR is set when the local
    endpoint has initiated key update. */
 #define NGTCP2_CONN_FLAG_KEY_UPDATE_INITIATOR 0x10000u
+/* NGTCP2_CONN_FLAG_EXPIRY_VALID indicates that conn->expiry holds
+   the earliest expiry of all timers. */
+#define NGTCP2_CONN_FLAG_EXPIRY_VALID 0x20000u
+/* NGTCP2_CONN_FLAG_USER_CC indicates that cc is the congestion
+   controller installed by ngtcp2_conn_set_cc_callbacks, and cc_algo
+   is not in effect. */
+#define NGTCP2_CONN_FLAG_USER_CC 0x40000u
+/* NGTCP2_CONN_FLAG_KEEP_ALIVE_EXTERNAL indicates that the
+   application schedules keep-alive, and the keep-alive timer is not
+   included in ngtcp2_conn_get_expiry. */
+#define NGTCP2_CONN_FLAG_KEEP_ALIVE_EXTERNAL 0x80000u
+/* NGTCP2_CONN_FLAG_SPIN_BIT indicates that the latency spin bit is
+   enabled for this connection. */
+#define NGTCP2_CONN_FLAG_SPIN_BIT 0x100000u
+
+/* ngtcp2_cc_resume_phase is the phase of Careful Resume which jumps
+   the congestion window to the one given by
+   ngtcp2_settings.cc_resume. */
+typedef enum ngtcp2_cc_resume_phase {
+  /* NGTCP2_CC_RESUME_PHASE_NONE indicates that Careful Resume is
+     not in use, or it has finished. */
+  NGTCP2_CC_RESUME_PHASE_NONE,
+  /* NGTCP2_CC_RESUME_PHASE_RECONNAISSANCE indicates that the
+     connection is waiting for the handshake confirmation and an RTT
+     sample to check the saved path state. */
+  NGTCP2_CC_RESUME_PHASE_RECONNAISSANCE,
+  /* NGTCP2_CC_RESUME_PHASE_UNVALIDATED indicates that the
+     congestion window has jumped, and the connection is waiting for
+     the first packet sent after the jump to be acknowledged. */
+  NGTCP2_CC_RESUME_PHASE_UNVALIDATED,
+} ngtcp2_cc_resume_phase;
+
+/* NGTCP2_CC_RESUME_MAX_PATHS is the maximum number of paths whose
+   congestion control state is remembered after the connection
+   migrates away from them. */
+#define NGTCP2_CC_RESUME_MAX_PATHS 4
+
+/* ngtcp2_cc_path_state is the congestion control state learned on a
+   path. */
+typedef struct ngtcp2_cc_path_state {
+  ngtcp2_path_storage ps;
+  ngtcp2_cc_resume_params params;
+} ngtcp2_cc_path_state;
 
 typedef struct ngtcp2_crypto_data {
   ngtcp2_buf buf;
@@ -243,6 +351,9 @@ typedef struct ngtcp2_pktns {
       /* ect0 is the number of QUIC packets, not UDP datagram, which
          are sent in UDP datagram with ECT0 marking. */
       size_t ect0;
+      /* ect1 is the number of QUIC packets which are sent in UDP
+         datagram with ECT1 marking. */
+      size_t ect1;
       /* start_pkt_num is the lowest packet number that are sent
          during ECN validation period. */
       int64_t start_pkt_num;
@@ -253,6 +364,23 @@ typedef struct ngtcp2_pktns {
          validation period. */
       size_t validation_pkt_lost;
     } ecn;
+
+    struct {
+      /* fr is ACK frame for this packet number space.  The
+         underlying buffer is reused. */
+      ngtcp2_frame *fr;
+      /* max_blks is the number of additional ngtcp2_ack_blk which fr
+         can contain. */
+      size_t max_blks;
+      /* acktr_gen is the value of acktr.gen when the ACK blocks in fr
+         were built.  While it matches, fr is reused without walking
+         acktr again.  UINT64_MAX means that fr holds nothing
+         reusable. */
+      uint64_t acktr_gen;
+      /* largest_ack_ts is the timestamp when the largest packet
+         acknowledged by fr was received. */
+      ngtcp2_tstamp largest_ack_ts;
+    } ack;
   } tx;
 
   struct {
@@ -288,6 +416,10 @@ typedef struct ngtcp2_pktns {
      *   ngtcp2_pktns.
      */
     ngtcp2_pkt_chain *buffed_pkts;
+    /* buffed_pkts_buf is the buffer which the packets in buffed_pkts
+       are stored in.  It is allocated when a packet is buffered
+       first, and freed when buffed_pkts is drained. */
+    ngtcp2_buf buffed_pkts_buf;
 
     struct {
       /* ect0, ect1, and ce are the number of QUIC packets received
@@ -295,6 +427,9 @@ typedef struct ngtcp2_pktns {
       size_t ect0;
       size_t ect1;
       size_t ce;
+      /* last_ce is nonzero if the last packet received was marked
+         with CE. */
+      int last_ce;
       struct {
         /* ect0, ect1, ce are the ECN counts received in the latest
            ACK frame. */
@@ -308,7 +443,7 @@ typedef struct ngtcp2_pktns {
   struct {
     struct {
       /* frq contains crypto data sorted by their offset. */
-      ngtcp2_ksl frq;
+      ngtcp2_cryptofrq frq;
       /* offset is the offset of crypto stream in this packet number
          space. */
       uint64_t offset;
@@ -355,85 +490,130 @@ ngtcp2_static_ringbuf_def(path_challenge, 4,
 
 ngtcp2_objalloc_def(strm, ngtcp2_strm, oplent);
 
+/* ngtcp2_conn_protect contains the 1RTT packets whose protection is
+   deferred until ngtcp2_conn_protect_pkts is called. */
+typedef struct ngtcp2_conn_protect {
+  /* cc is the crypto context which all pending packets are finalized
+     with. */
+  ngtcp2_crypto_cc cc;
+  ngtcp2_ppe_deferred pkts[NGTCP2_MAX_DEFERRED_PKTS];
+  ngtcp2_ppe_batch batch;
+  /* len is the number of pending packets in pkts. */
+  size_t len;
+} ngtcp2_conn_protect;
+
+/* ngtcp2_protect_job is the 1RTT packets detached from ngtcp2_conn
+   by ngtcp2_conn_detach_protect_job.  It carries everything needed
+   to protect them so that it can be run without touching the
+   connection. */
+struct ngtcp2_protect_job {
+  /* prev and next link the outstanding jobs of a connection. */
+  ngtcp2_protect_job *prev, *next;
+  /* cc is the crypto context which all packets are finalized
+     with. */
+  ngtcp2_crypto_cc cc;
+  ngtcp2_encrypt_batch encrypt_batch;
+  ngtcp2_hp_mask_batch hp_mask_batch;
+  ngtcp2_ppe_deferred pkts[NGTCP2_MAX_DEFERRED_PKTS];
+  ngtcp2_ppe_batch batch;
+  /* len is the number of packets in pkts. */
+  size_t len;
+};
+
+/* ngtcp2_conn_rx_hp contains the header protection masks of 1RTT
+   packets precomputed by ngtcp2_conn_prepare_rx_hp_masks. */
+typedef struct ngtcp2_conn_rx_hp {
+  /* pkts is the pointer to the beginning of each datagram. */
+  const uint8_t *pkts[NGTCP2_MAX_RX_HP_MASKS];
+  /* samples is the copy of sample of each packet to detect that the
+     buffer is altered. */
+  uint8_t samples[NGTCP2_MAX_RX_HP_MASKS][NGTCP2_HP_SAMPLELEN];
+  uint8_t masks[NGTCP2_MAX_RX_HP_MASKS * NGTCP2_HP_SAMPLELEN];
+  /* len is the number of precomputed masks. */
+  size_t len;
+  /* pos is the index of the mask which is expected to be used next. */
+  size_t pos;
+} ngtcp2_conn_rx_hp;
+
+/* ngtcp2_conn_published_stat is the copy of the connection
+   statistics which the other threads read with
+   ngtcp2_conn_get_published_conn_stat. */
+typedef struct ngtcp2_conn_published_stat {
+  ngtcp2_seqlock lock;
+  ngtcp2_conn_stat cstat;
+} ngtcp2_conn_published_stat;
+
+/*
+ * The members of ngtcp2_conn are ordered by how often they are
+ * accessed.  The state which the packet write and read paths touch
+ * for every packet comes first so that it shares as few cache lines
+ * as possible.  The state only used during the handshake, migration,
+ * or for statistics comes last, and the large buffers used only with
+ * the optional batch callbacks are allocated separately on demand.
+ */
 struct ngtcp2_conn {
-  ngtcp2_objalloc frc_objalloc;
-  ngtcp2_objalloc rtb_entry_objalloc;
-  ngtcp2_objalloc strm_objalloc;
+  /* flags is bitwise OR of zero or more of NGTCP2_CONN_FLAG_*. */
+  uint32_t flags;
   ngtcp2_conn_state state;
+  int server;
+  uint32_t negotiated_version;
+  uint32_t client_chosen_version;
+  /* mem is the allocator that the connection uses for everything but
+     the ngtcp2_conn object.  It is obtained from mem_acct if
+     ngtcp2_settings.mem_budget is nonzero, and is mem_acct.mem
+     otherwise. */
+  const ngtcp2_mem *mem;
+  void *user_data;
+  /* expiry is the earliest expiry of all timers cached by
+     ngtcp2_conn_get_expiry.  It is only valid if
+     NGTCP2_CONN_FLAG_EXPIRY_VALID is set. */
+  ngtcp2_tstamp expiry;
+  /* idle_ts is the time instant when idle timer started. */
+  ngtcp2_tstamp idle_ts;
   ngtcp2_callbacks callbacks;
-  /* rcid is a connection ID present in Initial or 0-RTT packet from
-     client as destination connection ID.  Server uses this field to
-     check that duplicated Initial or 0-RTT packet are indeed sent to
-     this connection.  Client uses this field to validate
-     original_destination_connection_id transport parameter. */
-  ngtcp2_cid rcid;
-  /* oscid is the source connection ID initially used by the local
-     endpoint. */
-  ngtcp2_cid oscid;
-  /* retry_scid is the source connection ID from Retry packet.  Client
-     records it in order to verify retry_source_connection_id
-     transport parameter.  Server does not use this field. */
-  ngtcp2_cid retry_scid;
-  ngtcp2_pktns *in_pktns;
-  ngtcp2_pktns *hs_pktns;
-  ngtcp2_pktns pktns;
-
-  struct {
-    /* current is the current destination connection ID. */
-    ngtcp2_dcid current;
-    /* bound is a set of destination connection IDs which are bound to
-       particular paths.  These paths are not validated yet. */
-    ngtcp2_static_ringbuf_dcid_bound bound;
-    /* unused is a set of unused CID received from peer. */
-    ngtcp2_static_ringbuf_dcid_unused unused;
-    /* retired is a set of CID retired by local endpoint.  Keep them
-       in 3*PTO to catch packets in flight along the old path. */
-    ngtcp2_static_ringbuf_dcid_retired retired;
-    /* seqgap tracks received sequence numbers in order to ignore
-       retransmitted duplicated NEW_CONNECTION_ID frame. */
-    ngtcp2_gaptr seqgap;
-    /* retire_prior_to is the largest retire_prior_to received so
-       far. */
-    uint64_t retire_prior_to;
-    struct {
-      /* seqs contains sequence number of Connection ID whose
-         retirement is not acknowledged by the remote endpoint yet. */
-      uint64_t seqs[NGTCP2_MAX_DCID_POOL_SIZE * 2];
-      /* len is the number of sequence numbers that seq contains. */
-      size_t len;
-    } retire_unacked;
-    /* zerolen_seq is a pseudo sequence number of zero-length
-       Destination Connection ID in order to distinguish between
-       them. */
-    uint64_t zerolen_seq;
-  } dcid;
+  /* frc_objalloc, rtb_entry_objalloc, and strm_objalloc point to the
+     object pools in objalloc, or the ones in ngtcp2_shared_pool if
+     ngtcp2_settings.shared_pool is given. */
+  ngtcp2_objalloc *frc_objalloc;
+  ngtcp2_objalloc *rtb_entry_objalloc;
+  ngtcp2_objalloc *strm_objalloc;
 
+  /* pkt contains the packet intermediate construction data to support
+     NGTCP2_WRITE_STREAM_FLAG_MORE */
   struct {
-    /* set is a set of CID sent to peer.  The peer can use any CIDs in
-       this set.  This includes used CID as well as unused ones. */
-    ngtcp2_ksl set;
-    /* used is a set of CID used by peer.  The sort function of this
-       priority queue takes timestamp when CID is retired and sorts
-       them in ascending order. */
-    ngtcp2_pq used;
-    /* last_seq is the last sequence number of connection ID. */
-    uint64_t last_seq;
-    /* num_retired is the number of retired Connection ID still
-       included in set. */
-    size_t num_retired;
-  } scid;
+    ngtcp2_crypto_cc cc;
+    ngtcp2_pkt_hd hd;
+    ngtcp2_ppe ppe;
+    /* hd_tmpl caches the encoded short header of 1RTT packet. */
+    ngtcp2_ppe_hd_tmpl hd_tmpl;
+    ngtcp2_frame_chain **pfrc;
+    int pkt_empty;
+    int hd_logged;
+    /* flags is bitwise OR of zero or more of
+       NGTCP2_RTB_ENTRY_FLAG_*. */
+    uint16_t rtb_entry_flags;
+    /* pto_reclaimed is nonzero if the packet carries the frames
+       reclaimed for PTO probe. */
+    int pto_reclaimed;
+    ngtcp2_ssize hs_spktlen;
+    int require_padding;
+  } pkt;
 
   struct {
-    /* strmq contains ngtcp2_strm which has frames to send. */
+    /* strmq contains ngtcp2_strm which has frames to send.  It is
+       used with NGTCP2_SCHED_POLICY_STRICT_PRIORITY, which orders
+       the streams by urgency first. */
     ngtcp2_pq strmq;
+    /* strmcq contains ngtcp2_strm which has frames to send.  It is
+       used instead of strmq with the other scheduling policies,
+       which order the streams by cycle only. */
+    ngtcp2_cycleq strmcq;
     /* strmq_nretrans is the number of entries in strmq which has
        stream data to resent. */
     size_t strmq_nretrans;
-    /* ack is ACK frame.  The underlying buffer is reused. */
-    ngtcp2_frame *ack;
-    /* max_ack_blks is the number of additional ngtcp2_ack_blk which
-       ack can contain. */
-    size_t max_ack_blks;
+    /* sched contains ngtcp2_strm which the application scheduled by
+       ngtcp2_conn_schedule_stream to send new data. */
+    ngtcp2_sched sched;
     /* offset is the offset the local endpoint has sent to the remote
        endpoint. */
     uint64_t offset;
@@ -443,6 +623,17 @@ struct ngtcp2_conn {
     /* last_max_data_ts is the timestamp when last MAX_DATA frame is
        sent. */
     ngtcp2_tstamp last_max_data_ts;
+    /* flow_update is the state of MAX_DATA and MAX_STREAM_DATA
+       frames which are deferred to be coalesced if
+       ngtcp2_settings.coalesce_flow_control_update is enabled. */
+    struct {
+      /* first_ts is the timestamp when the pending updates are first
+         deferred.  It is UINT64_MAX if nothing is deferred. */
+      ngtcp2_tstamp first_ts;
+      /* urgent is nonzero if the pending updates must be sent in the
+         next packet. */
+      int urgent;
+    } flow_update;
 
     struct {
       /* state is the state of ECN validation */
@@ -463,7 +654,42 @@ struct ngtcp2_conn {
       /* next_ts is the time to send next packet.  It is UINT64_MAX if
          packet pacing is disabled or expired.*/
       ngtcp2_tstamp next_ts;
+      /* departure_ts is the earliest departure time of the next
+         packet.  Unlike next_ts, it is not cleared when the pacing
+         timer expires.  It is only used if
+         ngtcp2_settings.pacing_horizon is nonzero. */
+      ngtcp2_tstamp departure_ts;
     } pacing;
+
+    struct {
+      /* seq is the sequence number of ACK_FREQUENCY frame to send
+         next. */
+      uint64_t seq;
+      /* ack_eliciting_threshold is Ack-Eliciting Threshold sent in
+         the last ACK_FREQUENCY frame. */
+      uint64_t ack_eliciting_threshold;
+      /* max_ack_delay is Request Max Ack Delay sent in the last
+         ACK_FREQUENCY frame. */
+      ngtcp2_duration max_ack_delay;
+      /* last_ts is the timestamp when the last ACK_FREQUENCY frame
+         is queued.  It is UINT64_MAX if none has been queued. */
+      ngtcp2_tstamp last_ts;
+    } ack_freq;
+    /* ampl_blocked_ts is the timestamp when the server started
+       waiting for the amplification limit budget to send Initial or
+       Handshake packets.  It is UINT64_MAX if the server is not
+       waiting. */
+    ngtcp2_tstamp ampl_blocked_ts;
+    /* repairq is the list of REPAIR frames which have not been sent
+       yet, in the order they are queued. */
+    ngtcp2_frame_chain *repairq;
+    /* dgramq is the list of DATAGRAMs which have not been sent yet,
+       in the order they are queued.  dgramq_tail points to its last
+       element. */
+    ngtcp2_dgram_entry *dgramq;
+    ngtcp2_dgram_entry *dgramq_tail;
+    /* dgramq_len is the number of DATAGRAMs in dgramq. */
+    size_t dgramq_len;
   } tx;
 
   struct {
@@ -483,31 +709,105 @@ struct ngtcp2_conn {
     ngtcp2_static_ringbuf_path_challenge path_challenge;
     /* ccerr is the received connection close error. */
     ngtcp2_connection_close_error ccerr;
+
+    struct {
+      /* next_seq is the smallest sequence number of ACK_FREQUENCY
+         frame which is still applied.  ACK_FREQUENCY frame with a
+         smaller sequence number is ignored. */
+      uint64_t next_seq;
+      /* ack_thresh is the number of ack-eliciting packets which
+         triggers an immediate acknowledgement.  It is initialized to
+         ngtcp2_settings.ack_thresh. */
+      uint64_t ack_thresh;
+      /* max_ack_delay is max_ack_delay requested by the remote
+         endpoint.  It is UINT64_MAX if no request is received. */
+      ngtcp2_duration max_ack_delay;
+      /* reordering_thresh is the number of reordered packets which
+         triggers an immediate acknowledgement.  0 means that
+         reordering never triggers it. */
+      uint64_t reordering_thresh;
+    } ack_freq;
+    /* pkt_begin and pkt_end delimit the buffer passed to
+       ngtcp2_conn_read_pkt while it is processed if
+       ngtcp2_settings.decrypt_in_place is set.  They are NULL
+       otherwise. */
+    const uint8_t *pkt_begin;
+    const uint8_t *pkt_end;
   } rx;
+  ngtcp2_conn_stat cstat;
+  ngtcp2_rst rst;
+  ngtcp2_cc_algo cc_algo;
+  ngtcp2_cc cc;
+  ngtcp2_map strms;
+  ngtcp2_pktns pktns;
+  ngtcp2_pktns *in_pktns;
+  ngtcp2_pktns *hs_pktns;
+
+  struct {
+    /* last_ts is a timestamp when a last packet is sent or received
+       on a current path. */
+    ngtcp2_tstamp last_ts;
+    /* timeout is keep-alive timeout.  When it expires, a packet
+       should be sent to a current path to keep connection alive.  It
+       might be used to keep NAT binding intact.  If 0 is set,
+       keep-alive timer is disabled. */
+    ngtcp2_duration timeout;
+  } keep_alive;
+  /* oscid is the source connection ID initially used by the local
+     endpoint. */
+  ngtcp2_cid oscid;
 
   struct {
-    ngtcp2_crypto_km *ckm;
-    ngtcp2_crypto_cipher_ctx hp_ctx;
-    ngtcp2_crypto_ctx ctx;
-    /* discard_started_ts is the timestamp when the timer to discard
-       early key has started.  Used by server only. */
-    ngtcp2_tstamp discard_started_ts;
-    /* transport_params is the values remembered by client from the
-       previous session.  These are set by
-       ngtcp2_conn_set_early_remote_transport_params().  Server does
-       not use this field.  Server must not set values for these
-       parameters that are smaller than the remembered values. */
     struct {
-      uint64_t initial_max_streams_bidi;
-      uint64_t initial_max_streams_uni;
-      uint64_t initial_max_stream_data_bidi_local;
-      uint64_t initial_max_stream_data_bidi_remote;
-      uint64_t initial_max_stream_data_uni;
-      uint64_t initial_max_data;
-      uint64_t active_connection_id_limit;
-      uint64_t max_datagram_frame_size;
-    } transport_params;
-  } early;
+      /* new_tx_ckm is a new sender 1RTT key which has not been
+         used. */
+      ngtcp2_crypto_km *new_tx_ckm;
+      /* new_rx_ckm is a new receiver 1RTT key which has not
+         successfully decrypted incoming packet yet. */
+      ngtcp2_crypto_km *new_rx_ckm;
+      /* old_rx_ckm is an old receiver 1RTT key. */
+      ngtcp2_crypto_km *old_rx_ckm;
+      /* confirmed_ts is the time instant when the key update is
+         confirmed by the local endpoint last time.  UINT64_MAX means
+         undefined value. */
+      ngtcp2_tstamp confirmed_ts;
+      /* jitter is a random value chosen per connection which places
+         the automatic key update between 3/4 and 7/8 of
+         ngtcp2_crypto_ctx.max_encryption, so that the connections do
+         not update keys at once. */
+      uint8_t jitter;
+      /* tx_key_id is the key ID of the current 1RTT tx key which is
+         passed to ngtcp2_callbacks.offload_tx_key.  It is
+         incremented by each key update. */
+      uint64_t tx_key_id;
+    } key_update;
+
+    /* tls_native_handle is a native handle to TLS session object. */
+    void *tls_native_handle;
+    /* decrypt_hp_buf is a buffer which is used to write unprotected
+       packet header. */
+    ngtcp2_vec decrypt_hp_buf;
+    /* decrypt_buf is a buffer which is used to write decrypted data. */
+    ngtcp2_vec decrypt_buf;
+    /* retry_aead is AEAD to verify Retry packet integrity.  It is
+       used by client only. */
+    ngtcp2_crypto_aead retry_aead;
+    /* retry_aead_ctx is AEAD cipher context to verify Retry packet
+       integrity.  It is used by client only. */
+    ngtcp2_crypto_aead_ctx retry_aead_ctx;
+    /* tls_error is TLS related error. */
+    int tls_error;
+    /* tls_alert is TLS alert generated by the local endpoint. */
+    uint8_t tls_alert;
+    /* decryption_failure_count is the number of received packets that
+       fail authentication. */
+    uint64_t decryption_failure_count;
+    /* restored_tx_use_count is the number of encryption applied with
+       the 1RTT tx key before ngtcp2_conn_decode_and_set_snapshot.  It
+       becomes the use_count of the key installed by
+       ngtcp2_conn_install_tx_key. */
+    uint64_t restored_tx_use_count;
+  } crypto;
 
   struct {
     ngtcp2_settings settings;
@@ -538,9 +838,13 @@ struct ngtcp2_conn {
        handshake.  It is used for Short packet only. */
     ngtcp2_transport_params *transport_params;
     /* pending_transport_params is received transport parameters
-       during handshake.  It is copied to transport_params when 1RTT
+       during handshake.  It is moved to transport_params when 1RTT
        key is available. */
     ngtcp2_transport_params *pending_transport_params;
+    /* transport_params_storage is the storage of the objects which
+       transport_params and pending_transport_params point to, so
+       that no memory is allocated for them. */
+    ngtcp2_transport_params_storage transport_params_storage[2];
     struct {
       ngtcp2_idtr idtr;
       /* unsent_max_streams is the maximum number of streams of peer
@@ -552,6 +856,14 @@ struct ngtcp2_conn {
          initiated bidirectional stream which the local endpoint can
          accept. */
       uint64_t max_streams;
+      /* window is the stream window which
+         ngtcp2_settings.auto_max_streams uses to decide when to send
+         MAX_STREAMS.  It grows up to
+         ngtcp2_settings.max_streams_window. */
+      uint64_t window;
+      /* blocked is nonzero if STREAMS_BLOCKED has been received, and
+         MAX_STREAMS has not been sent since then. */
+      int blocked;
     } bidi;
 
     struct {
@@ -565,73 +877,132 @@ struct ngtcp2_conn {
          initiated unidirectional stream which the local endpoint can
          accept. */
       uint64_t max_streams;
+      /* window is the stream window which
+         ngtcp2_settings.auto_max_streams uses to decide when to send
+         MAX_STREAMS.  It grows up to
+         ngtcp2_settings.max_streams_window. */
+      uint64_t window;
+      /* blocked is nonzero if STREAMS_BLOCKED has been received, and
+         MAX_STREAMS has not been sent since then. */
+      int blocked;
     } uni;
   } remote;
 
   struct {
-    struct {
-      /* new_tx_ckm is a new sender 1RTT key which has not been
-         used. */
-      ngtcp2_crypto_km *new_tx_ckm;
-      /* new_rx_ckm is a new receiver 1RTT key which has not
-         successfully decrypted incoming packet yet. */
-      ngtcp2_crypto_km *new_rx_ckm;
-      /* old_rx_ckm is an old receiver 1RTT key. */
-      ngtcp2_crypto_km *old_rx_ckm;
-      /* confirmed_ts is the time instant when the key update is
-         confirmed by the local endpoint last time.  UINT64_MAX means
-         undefined value. */
-      ngtcp2_tstamp confirmed_ts;
-    } key_update;
+    /* set is a set of CID sent to peer.  The peer can use any CIDs in
+       this set.  This includes used CID as well as unused ones. */
+    ngtcp2_ksl set;
+    /* used is a set of CID used by peer.  The sort function of this
+       priority queue takes timestamp when CID is retired and sorts
+       them in ascending order. */
+    ngtcp2_pq used;
+    /* last_seq is the last sequence number of connection ID. */
+    uint64_t last_seq;
+    /* num_retired is the number of retired Connection ID still
+       included in set. */
+    size_t num_retired;
+  } scid;
+  ngtcp2_pv *pv;
+  ngtcp2_pmtud *pmtud;
 
-    /* tls_native_handle is a native handle to TLS session object. */
-    void *tls_native_handle;
-    /* decrypt_hp_buf is a buffer which is used to write unprotected
-       packet header. */
-    ngtcp2_vec decrypt_hp_buf;
-    /* decrypt_buf is a buffer which is used to write decrypted data. */
-    ngtcp2_vec decrypt_buf;
-    /* retry_aead is AEAD to verify Retry packet integrity.  It is
-       used by client only. */
-    ngtcp2_crypto_aead retry_aead;
-    /* retry_aead_ctx is AEAD cipher context to verify Retry packet
-       integrity.  It is used by client only. */
-    ngtcp2_crypto_aead_ctx retry_aead_ctx;
-    /* tls_error is TLS related error. */
-    int tls_error;
-    /* tls_alert is TLS alert generated by the local endpoint. */
-    uint8_t tls_alert;
-    /* decryption_failure_count is the number of received packets that
-       fail authentication. */
-    uint64_t decryption_failure_count;
-  } crypto;
+  /* pmtud_bh is the state of black hole detection for Path MTU
+     Discovery. */
+  struct {
+    /* num_lost is the number of lost 1RTT packets larger than
+       NGTCP2_MAX_UDP_PAYLOAD_SIZE whose packet number is larger than
+       max_ack_pkt_num. */
+    size_t num_lost;
+    /* max_ack_pkt_num is the largest packet number of acknowledged
+       1RTT packet larger than NGTCP2_MAX_UDP_PAYLOAD_SIZE.  The loss
+       of a packet sent before it does not indicate black hole. */
+    int64_t max_ack_pkt_num;
+  } pmtud_bh;
+  ngtcp2_log log;
+  ngtcp2_qlog qlog;
+  /* protect contains the 1RTT packets whose protection is deferred
+     until ngtcp2_conn_protect_pkts is called.  It is allocated when
+     the first packet is deferred, which only happens if
+     callbacks.encrypt_batch is set. */
+  ngtcp2_conn_protect *protect;
+  /* protect_jobs is the list of jobs which are detached by
+     ngtcp2_conn_detach_protect_job and not released yet. */
+  ngtcp2_protect_job *protect_jobs;
+  /* rx_hp contains the header protection masks precomputed by
+     ngtcp2_conn_prepare_rx_hp_masks.  It is allocated when that
+     function is called first. */
+  ngtcp2_conn_rx_hp *rx_hp;
 
-  /* pkt contains the packet intermediate construction data to support
-     NGTCP2_WRITE_STREAM_FLAG_MORE */
   struct {
-    ngtcp2_crypto_cc cc;
-    ngtcp2_pkt_hd hd;
-    ngtcp2_ppe ppe;
-    ngtcp2_frame_chain **pfrc;
-    int pkt_empty;
-    int hd_logged;
-    /* flags is bitwise OR of zero or more of
-       NGTCP2_RTB_ENTRY_FLAG_*. */
-    uint16_t rtb_entry_flags;
-    ngtcp2_ssize hs_spktlen;
-    int require_padding;
-  } pkt;
+    /* current is the current destination connection ID. */
+    ngtcp2_dcid current;
+    /* bound is a set of destination connection IDs which are bound to
+       particular paths.  These paths are not validated yet. */
+    ngtcp2_static_ringbuf_dcid_bound bound;
+    /* unused is a set of unused CID received from peer. */
+    ngtcp2_static_ringbuf_dcid_unused unused;
+    /* retired is a set of CID retired by local endpoint.  Keep them
+       in 3*PTO to catch packets in flight along the old path. */
+    ngtcp2_static_ringbuf_dcid_retired retired;
+    /* seqgap tracks received sequence numbers in order to ignore
+       retransmitted duplicated NEW_CONNECTION_ID frame. */
+    ngtcp2_gaptr seqgap;
+    /* retire_prior_to is the largest retire_prior_to received so
+       far. */
+    uint64_t retire_prior_to;
+    struct {
+      /* seqs contains sequence number of Connection ID whose
+         retirement is not acknowledged by the remote endpoint yet. */
+      uint64_t seqs[NGTCP2_MAX_DCID_POOL_SIZE * 2];
+      /* len is the number of sequence numbers that seq contains. */
+      size_t len;
+    } retire_unacked;
+    /* zerolen_seq is a pseudo sequence number of zero-length
+       Destination Connection ID in order to distinguish between
+       them. */
+    uint64_t zerolen_seq;
+  } dcid;
 
   struct {
-    /* last_ts is a timestamp when a last packet is sent or received
-       on a current path. */
-    ngtcp2_tstamp last_ts;
-    /* timeout is keep-alive timeout.  When it expires, a packet
-       should be sent to a current path to keep connection alive.  It
-       might be used to keep NAT binding intact.  If 0 is set,
-       keep-alive timer is disabled. */
-    ngtcp2_duration timeout;
-  } keep_alive;
+    ngtcp2_objalloc frc;
+    ngtcp2_objalloc rtb_entry;
+    ngtcp2_objalloc strm;
+  } objalloc;
+  /* strm_pool keeps the sub-objects of the closed streams for reuse. */
+  ngtcp2_strm_pool strm_pool;
+  /* rcid is a connection ID present in Initial or 0-RTT packet from
+     client as destination connection ID.  Server uses this field to
+     check that duplicated Initial or 0-RTT packet are indeed sent to
+     this connection.  Client uses this field to validate
+     original_destination_connection_id transport parameter. */
+  ngtcp2_cid rcid;
+  /* retry_scid is the source connection ID from Retry packet.  Client
+     records it in order to verify retry_source_connection_id
+     transport parameter.  Server does not use this field. */
+  ngtcp2_cid retry_scid;
+
+  struct {
+    ngtcp2_crypto_km *ckm;
+    ngtcp2_crypto_cipher_ctx hp_ctx;
+    ngtcp2_crypto_ctx ctx;
+    /* discard_started_ts is the timestamp when the timer to discard
+       early key has started.  Used by server only. */
+    ngtcp2_tstamp discard_started_ts;
+    /* transport_params is the values remembered by client from the
+       previous session.  These are set by
+       ngtcp2_conn_set_early_remote_transport_params().  Server does
+       not use this field.  Server must not set values for these
+       parameters that are smaller than the remembered values. */
+    struct {
+      uint64_t initial_max_streams_bidi;
+      uint64_t initial_max_streams_uni;
+      uint64_t initial_max_stream_data_bidi_local;
+      uint64_t initial_max_stream_data_bidi_remote;
+      uint64_t initial_max_stream_data_uni;
+      uint64_t initial_max_data;
+      uint64_t active_connection_id_limit;
+      uint64_t max_datagram_frame_size;
+    } transport_params;
+  } early;
 
   struct {
     /* Initial keys for negotiated version.  If original version ==
@@ -668,24 +1039,60 @@ struct ngtcp2_conn {
     size_t other_versionslen;
   } vneg;
 
-  ngtcp2_map strms;
-  ngtcp2_conn_stat cstat;
-  ngtcp2_pv *pv;
-  ngtcp2_pmtud *pmtud;
-  ngtcp2_log log;
-  ngtcp2_qlog qlog;
-  ngtcp2_rst rst;
-  ngtcp2_cc_algo cc_algo;
-  ngtcp2_cc cc;
-  const ngtcp2_mem *mem;
-  /* idle_ts is the time instant when idle timer started. */
-  ngtcp2_tstamp idle_ts;
-  void *user_data;
-  uint32_t client_chosen_version;
-  uint32_t negotiated_version;
-  /* flags is bitwise OR of zero or more of NGTCP2_CONN_FLAG_*. */
-  uint32_t flags;
-  int server;
+  /* cc_resume is the state of Careful Resume. */
+  struct {
+    ngtcp2_cc_resume_phase phase;
+    /* params is the path state which the congestion window jumps
+       to.  It is ngtcp2_settings.cc_resume initially, and the state
+       remembered in paths after migration. */
+    ngtcp2_cc_resume_params params;
+    /* ps is the path on which the current congestion control state
+       has been learned. */
+    ngtcp2_path_storage ps;
+    /* paths contains the congestion control state of the paths which
+       the connection migrated away from.  The least recently used
+       one comes first. */
+    ngtcp2_cc_path_state paths[NGTCP2_CC_RESUME_MAX_PATHS];
+    /* npaths is the number of elements in paths. */
+    size_t npaths;
+    /* pkt_num is the packet number of the first 1RTT packet sent
+       after the congestion window jumped. */
+    int64_t pkt_num;
+    /* delivered is rst.delivered when the congestion window
+       jumped. */
+    uint64_t delivered;
+    /* ts is the time when the congestion window jumped. */
+    ngtcp2_tstamp ts;
+  } cc_resume;
+  /* perf accumulates the CPU time spent in each processing
+     phase. */
+  ngtcp2_perf perf;
+  /* stall accumulates the time during which sending was limited by
+     each cause. */
+  ngtcp2_stall stall;
+  /* published, if not NULL, is the copy of cstat which is updated
+     at the end of ngtcp2_conn_read_pkt and ngtcp2_conn_write_pkt.  It
+     is allocated if ngtcp2_settings.publish_conn_stat is nonzero. */
+  ngtcp2_conn_published_stat *published;
+  /* latency, if not NULL, records the latency histograms.  It is
+     allocated if ngtcp2_settings.latency_stat is nonzero. */
+  ngtcp2_latency_stat *latency;
+  /* hol is the sum of the head-of-line blocking statistics of all
+     streams. */
+  ngtcp2_hol_stat hol;
+  struct {
+    /* value is the spin bit value to send in 1RTT packet.  If the
+       spin bit is disabled, it is the random value chosen when the
+       connection is created. */
+    uint8_t value;
+    /* dcid_seq is the sequence number of the Destination Connection
+       ID which value is for.  value is reset to 0 when it changes. */
+    uint64_t dcid_seq;
+  } spin;
+  /* mem_acct counts the memory allocated by the connection if
+     ngtcp2_settings.mem_budget is nonzero.  The ngtcp2_conn object
+     itself is allocated from mem_acct.mem. */
+  ngtcp2_mem_acct mem_acct;
 };
 
 typedef enum ngtcp2_vmsg_type {
@@ -799,6 +1206,14 @@ int ngtcp2_conn_close_stream(ngtcp2_conn *conn, ngtcp2_strm *strm);
  */
 int ngtcp2_conn_close_stream_if_shut_rdwr(ngtcp2_conn *conn, ngtcp2_strm *strm);
 
+/*
+ * ngtcp2_conn_release_acked_stream_bufs calls release_stream_buf
+ * callback for the application buffers attached to |strm| whose data
+ * are all acknowledged, and forgets them.
+ */
+void ngtcp2_conn_release_acked_stream_bufs(ngtcp2_conn *conn,
+                                           ngtcp2_strm *strm);
+
 /*
  * ngtcp2_conn_update_rtt updates RTT measurements.  |rtt| is a latest
  * RTT which is not adjusted by ack delay.  |ack_delay| is unscaled
@@ -854,6 +1269,18 @@ void ngtcp2_conn_tx_strmq_pop(ngtcp2_conn *conn);
  */
 int ngtcp2_conn_tx_strmq_push(ngtcp2_conn *conn, ngtcp2_strm *strm);
 
+/*
+ * ngtcp2_conn_tx_strmq_remove removes |strm| from tx_strmq.  |strm|
+ * must be queued.  Removing a stream never shrinks the queue, so that
+ * the following ngtcp2_conn_tx_strmq_push does not fail.
+ */
+void ngtcp2_conn_tx_strmq_remove(ngtcp2_conn *conn, ngtcp2_strm *strm);
+
+/*
+ * ngtcp2_conn_tx_strmq_empty returns nonzero if tx_strmq is empty.
+ */
+int ngtcp2_conn_tx_strmq_empty(ngtcp2_conn *conn);
+
 /*
  * ngtcp2_conn_internal_expiry returns the minimum expiry time among
  * all timers in |conn|.
@@ -1091,6 +1518,25 @@ int ngtcp2_conn_start_pmtud(ngtcp2_conn *conn);
 
 void ngtcp2_conn_stop_pmtud(ngtcp2_conn *conn);
 
+/*
+ * ngtcp2_conn_detect_pmtud_black_hole is called when a 1RTT packet
+ * which is not a PMTUD probe is declared lost.  |pkt_num| is its
+ * packet number, and |pktlen| is its length.  If
+ * NGTCP2_PMTUD_BLACK_HOLE_THRESHOLD such packets larger than
+ * NGTCP2_MAX_UDP_PAYLOAD_SIZE are lost after the last one of them is
+ * acknowledged, this function lowers the maximum UDP payload size of
+ * the current path to NGTCP2_MAX_UDP_PAYLOAD_SIZE, and starts Path
+ * MTU Discovery over.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ */
+int ngtcp2_conn_detect_pmtud_black_hole(ngtcp2_conn *conn, int64_t pkt_num,
+                                        size_t pktlen);
+
 /**
  * @function
  *
@@ -31,6 +31,7 @@
 #include "ngtcp2_pkt.h"
 #include "ngtcp2_net.h"
 
+#ifdef NOINLINEHELPERS
 uint64_t ngtcp2_get_uint64(const uint8_t *p) {
   uint64_t n;
   memcpy(&n, p, 8);
@@ -92,6 +93,37 @@ uint64_t ngtcp2_get_varint(size_t *plen, const uint8_t *p) {
 
   return 0;
 }
+#endif /* NOINLINEHELPERS */
+
+ngtcp2_ssize ngtcp2_get_varints(uint64_t *dest, size_t n, const uint8_t *p,
+                                size_t len) {
+  const uint8_t *begin = p, *end = p + len;
+  size_t i, nlen;
+  uint64_t v;
+
+  for (i = 0; i < n; ++i) {
+    if (end - p >= 8) {
+      nlen = (size_t)(1u << (*p >> 6));
+      memcpy(&v, p, 8);
+      v = ngtcp2_ntohl64(v);
+      /* Drop the trailing bytes which belong to the next integers, and
+         then the 2 bits length prefix. */
+      dest[i] = (v >> (64 - nlen * 8)) & (UINT64_MAX >> (66 - nlen * 8));
+      p += nlen;
+
+      continue;
+    }
+
+    if (p == end || (size_t)(end - p) < ngtcp2_get_varint_len(p)) {
+      return -1;
+    }
+
+    dest[i] = ngtcp2_get_varint(&nlen, p);
+    p += nlen;
+  }
+
+  return p - begin;
+}
 
 int64_t ngtcp2_get_pkt_num(const uint8_t *p, size_t pkt_numlen) {
   switch (pkt_numlen) {
@@ -187,6 +219,7 @@ uint8_t *ngtcp2_put_pkt_num(uint8_t *p, int64_t pkt_num, size_t len) {
   }
 }
 
+#ifdef NOINLINEHELPERS
 size_t ngtcp2_get_varint_len(const uint8_t *p) {
   return (size_t)(1u << (*p >> 6));
 }
@@ -204,6 +237,7 @@ size_t ngtcp2_put_varint_len(uint64_t n) {
   assert(n < 4611686018427387904ULL);
   return 8;
 }
+#endif /* NOINLINEHELPERS */
 
 int64_t ngtcp2_nth_server_bidi_id(uint64_t n) {
   if (n == 0) {
@@ -29,49 +29,129 @@
 #  include <config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <string.h>
+#include <assert.h>
+
 #include <ngtcp2/ngtcp2.h>
 
+#include "ngtcp2_net.h"
+
+/* The small helpers which the other source files call in the hot
+   paths are defined inline here so that they are inlined without
+   LTO.  If NOINLINEHELPERS is defined, they are compiled out-of-line
+   in the source file instead. */
+
+#ifndef NOINLINEHELPERS
 /*
  * ngtcp2_get_uint64 reads 8 bytes from |p| as 64 bits unsigned
  * integer encoded as network byte order, and returns it in host byte
  * order.
  */
-uint64_t ngtcp2_get_uint64(const uint8_t *p);
+static inline uint64_t ngtcp2_get_uint64(const uint8_t *p) {
+  uint64_t n;
+  memcpy(&n, p, 8);
+  return ngtcp2_ntohl64(n);
+}
 
 /*
  * ngtcp2_get_uint48 reads 6 bytes from |p| as 48 bits unsigned
  * integer encoded as network byte order, and returns it in host byte
  * order.
  */
-uint64_t ngtcp2_get_uint48(const uint8_t *p);
+static inline uint64_t ngtcp2_get_uint48(const uint8_t *p) {
+  uint64_t n = 0;
+  memcpy(((uint8_t *)&n) + 2, p, 6);
+  return ngtcp2_ntohl64(n);
+}
 
 /*
  * ngtcp2_get_uint32 reads 4 bytes from |p| as 32 bits unsigned
  * integer encoded as network byte order, and returns it in host byte
  * order.
  */
-uint32_t ngtcp2_get_uint32(const uint8_t *p);
+static inline uint32_t ngtcp2_get_uint32(const uint8_t *p) {
+  uint32_t n;
+  memcpy(&n, p, 4);
+  return ngtcp2_ntohl(n);
+}
 
 /*
  * ngtcp2_get_uint24 reads 3 bytes from |p| as 24 bits unsigned
  * integer encoded as network byte order, and returns it in host byte
  * order.
  */
-uint32_t ngtcp2_get_uint24(const uint8_t *p);
+static inline uint32_t ngtcp2_get_uint24(const uint8_t *p) {
+  uint32_t n = 0;
+  memcpy(((uint8_t *)&n) + 1, p, 3);
+  return ngtcp2_ntohl(n);
+}
 
 /*
  * ngtcp2_get_uint16 reads 2 bytes from |p| as 16 bits unsigned
  * integer encoded as network byte order, and returns it in host byte
  * order.
  */
-uint16_t ngtcp2_get_uint16(const uint8_t *p);
+static inline uint16_t ngtcp2_get_uint16(const uint8_t *p) {
+  uint16_t n;
+  memcpy(&n, p, 2);
+  return ngtcp2_ntohs(n);
+}
 
 /*
  * ngtcp2_get_varint reads variable-length integer from |p|, and
  * returns it in host byte order.  The number of bytes read is stored
  * in |*plen|.
  */
+static inline uint64_t ngtcp2_get_varint(size_t *plen, const uint8_t *p) {
+  union {
+    char b[8];
+    uint16_t n16;
+    uint32_t n32;
+    uint64_t n64;
+  } n;
+
+  *plen = (size_t)(1u << (*p >> 6));
+
+  switch (*plen) {
+  case 1:
+    return *p;
+  case 2:
+    memcpy(&n, p, 2);
+    n.b[0] &= 0x3f;
+    return ngtcp2_ntohs(n.n16);
+  case 4:
+    memcpy(&n, p, 4);
+    n.b[0] &= 0x3f;
+    return ngtcp2_ntohl(n.n32);
+  case 8:
+    memcpy(&n, p, 8);
+    n.b[0] &= 0x3f;
+    return ngtcp2_ntohl64(n.n64);
+  default:
+    assert(0);
+  }
+
+  return 0;
+}
+#else /* NOINLINEHELPERS */
+uint64_t ngtcp2_get_uint64(const uint8_t *p);
+uint64_t ngtcp2_get_uint48(const uint8_t *p);
+uint32_t ngtcp2_get_uint32(const uint8_t *p);
+uint32_t ngtcp2_get_uint24(const uint8_t *p);
+uint16_t ngtcp2_get_uint16(const uint8_t *p);
 uint64_t ngtcp2_get_varint(size_t *plen, const uint8_t *p);
+#endif /* NOINLINEHELPERS */
+
+/*
+ * ngtcp2_get_varints reads |n| consecutive variable-length integers
+ * from |p| of length |len|, and stores them in |dest| in host byte
+ * order.  It returns the number of bytes read, or -1 if |p| ends
+ * before all of them are read.  While at least 8 bytes remain, each
+ * integer is decoded from a single 8 bytes load without branching on
+ * its length.
+ */
+ngtcp2_ssize ngtcp2_get_varints(uint64_t *dest, size_t n, const uint8_t *p,
+                                size_t len);
 
 /*
  * ngtcp2_get_pkt_num reads encoded packet number from |p|.  The
@@ -134,17 +214,36 @@ uint8_t *ngtcp2_put_varint30(uint8_t *p, uint32_t n);
  */
 uint8_t *ngtcp2_put_pkt_num(uint8_t *p, int64_t pkt_num, size_t len);
 
+#ifndef NOINLINEHELPERS
 /*
  * ngtcp2_get_varint_len returns the required number of bytes to read
  * variable-length integer starting at |p|.
  */
-size_t ngtcp2_get_varint_len(const uint8_t *p);
+static inline size_t ngtcp2_get_varint_len(const uint8_t *p) {
+  return (size_t)(1u << (*p >> 6));
+}
 
 /*
  * ngtcp2_put_varint_len returns the required number of bytes to
  * encode |n|.
  */
+static inline size_t ngtcp2_put_varint_len(uint64_t n) {
+  if (n < 64) {
+    return 1;
+  }
+  if (n < 16384) {
+    return 2;
+  }
+  if (n < 1073741824) {
+    return 4;
+  }
+  assert(n < 4611686018427387904ULL);
+  return 8;
+}
+#else /* NOINLINEHELPERS */
+size_t ngtcp2_get_varint_len(const uint8_t *p);
 size_t ngtcp2_put_varint_len(uint64_t n);
+#endif /* NOINLINEHELPERS */
 
 /*
  * ngtcp2_nth_server_bidi_id returns |n|-th server bidirectional
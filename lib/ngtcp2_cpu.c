@@ -0,0 +1,294 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_cpu.h"
+
+#include <string.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) &&                               \
+  (defined(__x86_64__) || defined(__i386__))
+#  define CPU_X86 1
+#  include <cpuid.h>
+#  include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  define CPU_X86 1
+#  include <intrin.h>
+#  include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#  define CPU_ARM64 1
+#  include <arm_neon.h>
+#  ifdef __linux__
+#    include <sys/auxv.h>
+#  endif /* defined(__linux__) */
+#endif
+
+/* CPU_X86_AVX2 is defined if this build can compile the AVX2 kernels
+   which are only called if the CPU supports AVX2. */
+#if defined(CPU_X86) && (defined(__GNUC__) || defined(__clang__))
+#  define CPU_X86_AVX2 1
+#  define CPU_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(CPU_X86) && defined(_MSC_VER)
+#  define CPU_X86_AVX2 1
+#  define CPU_TARGET_AVX2
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#  define cpu_load(P) __atomic_load_n((P), __ATOMIC_RELAXED)
+#  define cpu_store(P, N) __atomic_store_n((P), (N), __ATOMIC_RELAXED)
+#else /* !(defined(__GNUC__) || defined(__clang__)) */
+/* The aligned 32 bit and pointer sized volatile accesses are
+   atomic. */
+#  define cpu_load(P) (*(P))
+#  define cpu_store(P, N) (*(P) = (N))
+#endif /* !(defined(__GNUC__) || defined(__clang__)) */
+
+/* CPU_DETECTED is set in cpu_features once the detection has been
+   done. */
+#define CPU_DETECTED 0x80000000u
+
+#if defined(__GNUC__) || defined(__clang__)
+static uint32_t cpu_features;
+static const ngtcp2_cpu_dispatch *cpu_dispatch;
+#else /* !(defined(__GNUC__) || defined(__clang__)) */
+static volatile uint32_t cpu_features;
+static const ngtcp2_cpu_dispatch *volatile cpu_dispatch;
+#endif /* !(defined(__GNUC__) || defined(__clang__)) */
+
+#ifdef CPU_X86
+static void cpu_cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *regs) {
+#  ifdef _MSC_VER
+  int r[4];
+
+  __cpuidex(r, (int)leaf, (int)subleaf);
+
+  regs[0] = (uint32_t)r[0];
+  regs[1] = (uint32_t)r[1];
+  regs[2] = (uint32_t)r[2];
+  regs[3] = (uint32_t)r[3];
+#  else  /* !defined(_MSC_VER) */
+  unsigned int eax, ebx, ecx, edx;
+
+  __cpuid_count(leaf, subleaf, eax, ebx, ecx, edx);
+
+  regs[0] = eax;
+  regs[1] = ebx;
+  regs[2] = ecx;
+  regs[3] = edx;
+#  endif /* !defined(_MSC_VER) */
+}
+
+static uint64_t cpu_xgetbv(void) {
+#  ifdef _MSC_VER
+  return _xgetbv(0);
+#  else  /* !defined(_MSC_VER) */
+  uint32_t eax, edx;
+
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+
+  return ((uint64_t)edx << 32) | eax;
+#  endif /* !defined(_MSC_VER) */
+}
+
+static uint32_t cpu_detect(void) {
+  uint32_t regs[4];
+  uint32_t maxleaf, ecx1;
+  uint32_t features = 0;
+  uint64_t xcr0 = 0;
+  int ymm, zmm;
+
+  cpu_cpuid(0, 0, regs);
+  maxleaf = regs[0];
+
+  if (maxleaf < 1) {
+    return 0;
+  }
+
+  cpu_cpuid(1, 0, regs);
+  ecx1 = regs[2];
+
+  if (ecx1 & (1u << 20)) {
+    features |= NGTCP2_CPU_SSE42;
+  }
+
+  if (ecx1 & (1u << 25)) {
+    features |= NGTCP2_CPU_AESNI;
+  }
+
+  /* The wider registers are only usable if OS saves them on context
+     switch. */
+  if (ecx1 & (1u << 27)) {
+    xcr0 = cpu_xgetbv();
+  }
+
+  ymm = (ecx1 & (1u << 28)) && (xcr0 & 0x6) == 0x6;
+  zmm = ymm && (xcr0 & 0xe0) == 0xe0;
+
+  if (maxleaf < 7) {
+    return features;
+  }
+
+  cpu_cpuid(7, 0, regs);
+
+  if (ymm && (regs[1] & (1u << 5))) {
+    features |= NGTCP2_CPU_AVX2;
+  }
+
+  if (zmm && (regs[1] & (1u << 16)) && (regs[1] & (1u << 30))) {
+    features |= NGTCP2_CPU_AVX512;
+  }
+
+  if (ymm && (features & NGTCP2_CPU_AESNI) && (regs[2] & (1u << 9))) {
+    features |= NGTCP2_CPU_VAES;
+  }
+
+  return features;
+}
+#elif defined(CPU_ARM64)
+static uint32_t cpu_detect(void) {
+  /* Advanced SIMD is mandatory on AArch64. */
+  uint32_t features = NGTCP2_CPU_NEON;
+#  ifdef __linux__
+  unsigned long hwcap = getauxval(AT_HWCAP);
+
+  /* HWCAP_AES and HWCAP_SVE */
+  if (hwcap & (1ul << 3)) {
+    features |= NGTCP2_CPU_ARM_AES;
+  }
+
+  if (hwcap & (1ul << 22)) {
+    features |= NGTCP2_CPU_SVE;
+  }
+#  elif defined(__ARM_FEATURE_AES) || defined(__ARM_FEATURE_CRYPTO)
+  features |= NGTCP2_CPU_ARM_AES;
+#  endif /* defined(__ARM_FEATURE_AES) || defined(__ARM_FEATURE_CRYPTO) */
+
+  return features;
+}
+#else  /* !defined(CPU_X86) && !defined(CPU_ARM64) */
+static uint32_t cpu_detect(void) { return 0; }
+#endif /* !defined(CPU_X86) && !defined(CPU_ARM64) */
+
+uint32_t ngtcp2_cpu_get_features(void) {
+  uint32_t features = cpu_load(&cpu_features);
+
+  if (!(features & CPU_DETECTED)) {
+    /* The detection is idempotent, so that the threads which race
+       here store the same value. */
+    features = cpu_detect() | CPU_DETECTED;
+    cpu_store(&cpu_features, features);
+  }
+
+  return features & ~CPU_DETECTED;
+}
+
+static void cpu_memxor_generic(uint8_t *dest, const uint8_t *src, size_t n) {
+  uint64_t a, b;
+
+  for (; n >= 8; n -= 8, dest += 8, src += 8) {
+    memcpy(&a, dest, 8);
+    memcpy(&b, src, 8);
+    a ^= b;
+    memcpy(dest, &a, 8);
+  }
+
+  for (; n; --n) {
+    *dest++ ^= *src++;
+  }
+}
+
+static const ngtcp2_cpu_dispatch cpu_dispatch_generic = {
+  cpu_memxor_generic,
+};
+
+#ifdef CPU_X86_AVX2
+CPU_TARGET_AVX2
+static void cpu_memxor_avx2(uint8_t *dest, const uint8_t *src, size_t n) {
+  __m256i a, b;
+
+  for (; n >= 32; n -= 32, dest += 32, src += 32) {
+    a = _mm256_loadu_si256((const __m256i *)(const void *)dest);
+    b = _mm256_loadu_si256((const __m256i *)(const void *)src);
+    _mm256_storeu_si256((__m256i *)(void *)dest, _mm256_xor_si256(a, b));
+  }
+
+  cpu_memxor_generic(dest, src, n);
+}
+
+static const ngtcp2_cpu_dispatch cpu_dispatch_avx2 = {
+  cpu_memxor_avx2,
+};
+#endif /* defined(CPU_X86_AVX2) */
+
+#ifdef CPU_ARM64
+static void cpu_memxor_neon(uint8_t *dest, const uint8_t *src, size_t n) {
+  for (; n >= 16; n -= 16, dest += 16, src += 16) {
+    vst1q_u8(dest, veorq_u8(vld1q_u8(dest), vld1q_u8(src)));
+  }
+
+  cpu_memxor_generic(dest, src, n);
+}
+
+static const ngtcp2_cpu_dispatch cpu_dispatch_neon = {
+  cpu_memxor_neon,
+};
+#endif /* defined(CPU_ARM64) */
+
+const ngtcp2_cpu_dispatch *ngtcp2_cpu_select_dispatch(uint32_t features) {
+  /* AVX-512 is not used because the buffers which the kernels
+     process are at most a packet long, which is too short to pay off
+     the frequency transition that 512 bit instructions cause on some
+     CPUs. */
+#ifdef CPU_X86_AVX2
+  if (features & NGTCP2_CPU_AVX2) {
+    return &cpu_dispatch_avx2;
+  }
+#endif /* defined(CPU_X86_AVX2) */
+
+#ifdef CPU_ARM64
+  if (features & NGTCP2_CPU_NEON) {
+    return &cpu_dispatch_neon;
+  }
+#endif /* defined(CPU_ARM64) */
+
+  (void)features;
+
+  return &cpu_dispatch_generic;
+}
+
+const ngtcp2_cpu_dispatch *ngtcp2_cpu_get_dispatch(void) {
+  const ngtcp2_cpu_dispatch *dispatch = cpu_load(&cpu_dispatch);
+
+  if (dispatch == NULL) {
+    /* The tables are immutable, and every thread selects the same
+       one, so that publishing the pointer needs no ordering. */
+    dispatch = ngtcp2_cpu_select_dispatch(ngtcp2_cpu_get_features());
+    cpu_store(&cpu_dispatch, dispatch);
+  }
+
+  return dispatch;
+}
+
+void ngtcp2_cpu_memxor(uint8_t *dest, const uint8_t *src, size_t n) {
+  ngtcp2_cpu_get_dispatch()->memxor(dest, src, n);
+}
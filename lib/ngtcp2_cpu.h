@@ -0,0 +1,83 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGTCP2_CPU_H
+#define NGTCP2_CPU_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <ngtcp2/ngtcp2.h>
+
+/* The CPU features which ngtcp2_cpu_get_features detects. */
+#define NGTCP2_CPU_SSE42 0x01u
+#define NGTCP2_CPU_AESNI 0x02u
+#define NGTCP2_CPU_AVX2 0x04u
+/* NGTCP2_CPU_AVX512 is set if AVX-512F and AVX-512BW are
+   available. */
+#define NGTCP2_CPU_AVX512 0x08u
+#define NGTCP2_CPU_VAES 0x10u
+#define NGTCP2_CPU_NEON 0x100u
+#define NGTCP2_CPU_SVE 0x200u
+#define NGTCP2_CPU_ARM_AES 0x400u
+
+/*
+ * ngtcp2_cpu_dispatch is the table of the kernels which have the
+ * implementations specialized for the CPU features.
+ */
+typedef struct ngtcp2_cpu_dispatch {
+  /* memxor XORs |n| bytes pointed by |src| into |dest|.  |dest| and
+     |src| must not overlap. */
+  void (*memxor)(uint8_t *dest, const uint8_t *src, size_t n);
+} ngtcp2_cpu_dispatch;
+
+/*
+ * ngtcp2_cpu_get_features returns the bitwise OR of NGTCP2_CPU_*
+ * which the CPU and OS support.  The detection is done once, and the
+ * result is cached.
+ */
+uint32_t ngtcp2_cpu_get_features(void);
+
+/*
+ * ngtcp2_cpu_select_dispatch returns the dispatch table which is the
+ * best for |features|, which is the bitwise OR of NGTCP2_CPU_*.  The
+ * features which this build cannot make use of are ignored.
+ */
+const ngtcp2_cpu_dispatch *ngtcp2_cpu_select_dispatch(uint32_t features);
+
+/*
+ * ngtcp2_cpu_get_dispatch returns the dispatch table selected for the
+ * running CPU.  The table is selected when this function is called
+ * for the first time.
+ */
+const ngtcp2_cpu_dispatch *ngtcp2_cpu_get_dispatch(void);
+
+/*
+ * ngtcp2_cpu_memxor XORs |n| bytes pointed by |src| into |dest| using
+ * the kernel selected for the running CPU.
+ */
+void ngtcp2_cpu_memxor(uint8_t *dest, const uint8_t *src, size_t n);
+
+#endif /* NGTCP2_CPU_H */
@@ -149,54 +149,12 @@ static uint8_t *write_cid_param(uint8_t *p, ngtcp2_transport_param_id id,
   return p;
 }
 
-static const uint8_t empty_address[16];
-
-ngtcp2_ssize ngtcp2_encode_transport_params_versioned(
-    uint8_t *dest, size_t destlen, ngtcp2_transport_params_type exttype,
-    int transport_params_version, const ngtcp2_transport_params *params) {
-  uint8_t *p;
+/*
+ * static_paramslen returns the length of transport parameters in
+ * |params| which do not depend on a particular connection.
+ */
+static size_t static_paramslen(const ngtcp2_transport_params *params) {
   size_t len = 0;
-  /* For some reason, gcc 7.3.0 requires this initialization. */
-  size_t preferred_addrlen = 0;
-  size_t version_infolen = 0;
-  (void)transport_params_version;
-
-  switch (exttype) {
-  case NGTCP2_TRANSPORT_PARAMS_TYPE_CLIENT_HELLO:
-    break;
-  case NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS:
-    len +=
-        cid_paramlen(NGTCP2_TRANSPORT_PARAM_ORIGINAL_DESTINATION_CONNECTION_ID,
-                     &params->original_dcid);
-
-    if (params->stateless_reset_token_present) {
-      len +=
-          ngtcp2_put_varint_len(NGTCP2_TRANSPORT_PARAM_STATELESS_RESET_TOKEN) +
-          ngtcp2_put_varint_len(NGTCP2_STATELESS_RESET_TOKENLEN) +
-          NGTCP2_STATELESS_RESET_TOKENLEN;
-    }
-    if (params->preferred_address_present) {
-      assert(params->preferred_address.cid.datalen >= NGTCP2_MIN_CIDLEN);
-      assert(params->preferred_address.cid.datalen <= NGTCP2_MAX_CIDLEN);
-      preferred_addrlen = 4 /* ipv4Address */ + 2 /* ipv4Port */ +
-                          16 /* ipv6Address */ + 2 /* ipv6Port */
-                          + 1 +
-                          params->preferred_address.cid.datalen /* CID */ +
-                          NGTCP2_STATELESS_RESET_TOKENLEN;
-      len += ngtcp2_put_varint_len(NGTCP2_TRANSPORT_PARAM_PREFERRED_ADDRESS) +
-             ngtcp2_put_varint_len(preferred_addrlen) + preferred_addrlen;
-    }
-    if (params->retry_scid_present) {
-      len += cid_paramlen(NGTCP2_TRANSPORT_PARAM_RETRY_SOURCE_CONNECTION_ID,
-                          &params->retry_scid);
-    }
-    break;
-  default:
-    return NGTCP2_ERR_INVALID_ARGUMENT;
-  }
-
-  len += cid_paramlen(NGTCP2_TRANSPORT_PARAM_INITIAL_SOURCE_CONNECTION_ID,
-                      &params->initial_scid);
 
   if (params->initial_max_stream_data_bidi_local) {
     len += varint_paramlen(
@@ -260,76 +218,25 @@ ngtcp2_ssize ngtcp2_encode_transport_params_versioned(
     len += ngtcp2_put_varint_len(NGTCP2_TRANSPORT_PARAM_GREASE_QUIC_BIT) +
            ngtcp2_put_varint_len(0);
   }
-  if (params->version_info_present) {
-    version_infolen = sizeof(uint32_t) + params->version_info.other_versionslen;
-    len += ngtcp2_put_varint_len(
-               NGTCP2_TRANSPORT_PARAM_VERSION_INFORMATION_DRAFT) +
-           ngtcp2_put_varint_len(version_infolen) + version_infolen;
+  if (params->min_ack_delay) {
+    len += varint_paramlen(NGTCP2_TRANSPORT_PARAM_MIN_ACK_DELAY_DRAFT,
+                           params->min_ack_delay / NGTCP2_MICROSECONDS);
   }
-
-  if (dest == NULL && destlen == 0) {
-    return (ngtcp2_ssize)len;
+  if (params->fec_window) {
+    len += varint_paramlen(NGTCP2_TRANSPORT_PARAM_FEC_WINDOW_EXPERIMENTAL,
+                           params->fec_window);
   }
 
-  if (destlen < len) {
-    return NGTCP2_ERR_NOBUF;
-  }
-
-  p = dest;
-
-  if (exttype == NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS) {
-    p = write_cid_param(
-        p, NGTCP2_TRANSPORT_PARAM_ORIGINAL_DESTINATION_CONNECTION_ID,
-        &params->original_dcid);
-
-    if (params->stateless_reset_token_present) {
-      p = ngtcp2_put_varint(p, NGTCP2_TRANSPORT_PARAM_STATELESS_RESET_TOKEN);
-      p = ngtcp2_put_varint(p, sizeof(params->stateless_reset_token));
-      p = ngtcp2_cpymem(p, params->stateless_reset_token,
-                        sizeof(params->stateless_reset_token));
-    }
-    if (params->preferred_address_present) {
-      p = ngtcp2_put_varint(p, NGTCP2_TRANSPORT_PARAM_PREFERRED_ADDRESS);
-      p = ngtcp2_put_varint(p, preferred_addrlen);
-
-      if (params->preferred_address.ipv4_present) {
-        p = ngtcp2_cpymem(p, params->preferred_address.ipv4_addr,
-                          sizeof(params->preferred_address.ipv4_addr));
-        p = ngtcp2_put_uint16be(p, params->preferred_address.ipv4_port);
-      } else {
-        p = ngtcp2_cpymem(p, empty_address,
-                          sizeof(params->preferred_address.ipv4_addr));
-        p = ngtcp2_put_uint16be(p, 0);
-      }
-
-      if (params->preferred_address.ipv6_present) {
-        p = ngtcp2_cpymem(p, params->preferred_address.ipv6_addr,
-                          sizeof(params->preferred_address.ipv6_addr));
-        p = ngtcp2_put_uint16be(p, params->preferred_address.ipv6_port);
-      } else {
-        p = ngtcp2_cpymem(p, empty_address,
-                          sizeof(params->preferred_address.ipv6_addr));
-        p = ngtcp2_put_uint16be(p, 0);
-      }
-
-      *p++ = (uint8_t)params->preferred_address.cid.datalen;
-      if (params->preferred_address.cid.datalen) {
-        p = ngtcp2_cpymem(p, params->preferred_address.cid.data,
-                          params->preferred_address.cid.datalen);
-      }
-      p = ngtcp2_cpymem(
-          p, params->preferred_address.stateless_reset_token,
-          sizeof(params->preferred_address.stateless_reset_token));
-    }
-    if (params->retry_scid_present) {
-      p = write_cid_param(p, NGTCP2_TRANSPORT_PARAM_RETRY_SOURCE_CONNECTION_ID,
-                          &params->retry_scid);
-    }
-  }
-
-  p = write_cid_param(p, NGTCP2_TRANSPORT_PARAM_INITIAL_SOURCE_CONNECTION_ID,
-                      &params->initial_scid);
+  return len;
+}
 
+/*
+ * write_static_params writes transport parameters in |params| which
+ * do not depend on a particular connection.  It returns p + the
+ * number of bytes written.
+ */
+static uint8_t *write_static_params(uint8_t *p,
+                                    const ngtcp2_transport_params *params) {
   if (params->initial_max_stream_data_bidi_local) {
     p = write_varint_param(
         p, NGTCP2_TRANSPORT_PARAM_INITIAL_MAX_STREAM_DATA_BIDI_LOCAL,
@@ -406,6 +313,153 @@ ngtcp2_ssize ngtcp2_encode_transport_params_versioned(
     p = ngtcp2_put_varint(p, 0);
   }
 
+  if (params->min_ack_delay) {
+    p = write_varint_param(p, NGTCP2_TRANSPORT_PARAM_MIN_ACK_DELAY_DRAFT,
+                           params->min_ack_delay / NGTCP2_MICROSECONDS);
+  }
+
+  if (params->fec_window) {
+    p = write_varint_param(p, NGTCP2_TRANSPORT_PARAM_FEC_WINDOW_EXPERIMENTAL,
+                           params->fec_window);
+  }
+
+  return p;
+}
+
+static const uint8_t empty_address[16];
+
+/*
+ * encode_transport_params encodes |params| in |dest|.  If |tmpl| is
+ * not NULL, the parameters which do not depend on a particular
+ * connection are copied from |tmpl| instead of being encoded from
+ * |params|.
+ */
+static ngtcp2_ssize
+encode_transport_params(uint8_t *dest, size_t destlen,
+                        ngtcp2_transport_params_type exttype,
+                        const ngtcp2_transport_params *params,
+                        const ngtcp2_transport_params_template *tmpl) {
+  uint8_t *p;
+  size_t len = 0;
+  /* For some reason, gcc 7.3.0 requires this initialization. */
+  size_t preferred_addrlen = 0;
+  size_t version_infolen = 0;
+
+  switch (exttype) {
+  case NGTCP2_TRANSPORT_PARAMS_TYPE_CLIENT_HELLO:
+    break;
+  case NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS:
+    len +=
+        cid_paramlen(NGTCP2_TRANSPORT_PARAM_ORIGINAL_DESTINATION_CONNECTION_ID,
+                     &params->original_dcid);
+
+    if (params->stateless_reset_token_present) {
+      len +=
+          ngtcp2_put_varint_len(NGTCP2_TRANSPORT_PARAM_STATELESS_RESET_TOKEN) +
+          ngtcp2_put_varint_len(NGTCP2_STATELESS_RESET_TOKENLEN) +
+          NGTCP2_STATELESS_RESET_TOKENLEN;
+    }
+    if (params->preferred_address_present) {
+      assert(params->preferred_address.cid.datalen >= NGTCP2_MIN_CIDLEN);
+      assert(params->preferred_address.cid.datalen <= NGTCP2_MAX_CIDLEN);
+      preferred_addrlen = 4 /* ipv4Address */ + 2 /* ipv4Port */ +
+                          16 /* ipv6Address */ + 2 /* ipv6Port */
+                          + 1 +
+                          params->preferred_address.cid.datalen /* CID */ +
+                          NGTCP2_STATELESS_RESET_TOKENLEN;
+      len += ngtcp2_put_varint_len(NGTCP2_TRANSPORT_PARAM_PREFERRED_ADDRESS) +
+             ngtcp2_put_varint_len(preferred_addrlen) + preferred_addrlen;
+    }
+    if (params->retry_scid_present) {
+      len += cid_paramlen(NGTCP2_TRANSPORT_PARAM_RETRY_SOURCE_CONNECTION_ID,
+                          &params->retry_scid);
+    }
+    break;
+  default:
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  len += cid_paramlen(NGTCP2_TRANSPORT_PARAM_INITIAL_SOURCE_CONNECTION_ID,
+                      &params->initial_scid);
+
+  len += tmpl ? tmpl->datalen : static_paramslen(params);
+
+  if (params->version_info_present) {
+    version_infolen = sizeof(uint32_t) + params->version_info.other_versionslen;
+    len += ngtcp2_put_varint_len(
+               NGTCP2_TRANSPORT_PARAM_VERSION_INFORMATION_DRAFT) +
+           ngtcp2_put_varint_len(version_infolen) + version_infolen;
+  }
+
+  if (dest == NULL && destlen == 0) {
+    return (ngtcp2_ssize)len;
+  }
+
+  if (destlen < len) {
+    return NGTCP2_ERR_NOBUF;
+  }
+
+  p = dest;
+
+  if (exttype == NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS) {
+    p = write_cid_param(
+        p, NGTCP2_TRANSPORT_PARAM_ORIGINAL_DESTINATION_CONNECTION_ID,
+        &params->original_dcid);
+
+    if (params->stateless_reset_token_present) {
+      p = ngtcp2_put_varint(p, NGTCP2_TRANSPORT_PARAM_STATELESS_RESET_TOKEN);
+      p = ngtcp2_put_varint(p, sizeof(params->stateless_reset_token));
+      p = ngtcp2_cpymem(p, params->stateless_reset_token,
+                        sizeof(params->stateless_reset_token));
+    }
+    if (params->preferred_address_present) {
+      p = ngtcp2_put_varint(p, NGTCP2_TRANSPORT_PARAM_PREFERRED_ADDRESS);
+      p = ngtcp2_put_varint(p, preferred_addrlen);
+
+      if (params->preferred_address.ipv4_present) {
+        p = ngtcp2_cpymem(p, params->preferred_address.ipv4_addr,
+                          sizeof(params->preferred_address.ipv4_addr));
+        p = ngtcp2_put_uint16be(p, params->preferred_address.ipv4_port);
+      } else {
+        p = ngtcp2_cpymem(p, empty_address,
+                          sizeof(params->preferred_address.ipv4_addr));
+        p = ngtcp2_put_uint16be(p, 0);
+      }
+
+      if (params->preferred_address.ipv6_present) {
+        p = ngtcp2_cpymem(p, params->preferred_address.ipv6_addr,
+                          sizeof(params->preferred_address.ipv6_addr));
+        p = ngtcp2_put_uint16be(p, params->preferred_address.ipv6_port);
+      } else {
+        p = ngtcp2_cpymem(p, empty_address,
+                          sizeof(params->preferred_address.ipv6_addr));
+        p = ngtcp2_put_uint16be(p, 0);
+      }
+
+      *p++ = (uint8_t)params->preferred_address.cid.datalen;
+      if (params->preferred_address.cid.datalen) {
+        p = ngtcp2_cpymem(p, params->preferred_address.cid.data,
+                          params->preferred_address.cid.datalen);
+      }
+      p = ngtcp2_cpymem(
+          p, params->preferred_address.stateless_reset_token,
+          sizeof(params->preferred_address.stateless_reset_token));
+    }
+    if (params->retry_scid_present) {
+      p = write_cid_param(p, NGTCP2_TRANSPORT_PARAM_RETRY_SOURCE_CONNECTION_ID,
+                          &params->retry_scid);
+    }
+  }
+
+  p = write_cid_param(p, NGTCP2_TRANSPORT_PARAM_INITIAL_SOURCE_CONNECTION_ID,
+                      &params->initial_scid);
+
+  if (tmpl) {
+    p = ngtcp2_cpymem(p, tmpl->data, tmpl->datalen);
+  } else {
+    p = write_static_params(p, params);
+  }
+
   if (params->version_info_present) {
     p = ngtcp2_put_varint(p, NGTCP2_TRANSPORT_PARAM_VERSION_INFORMATION_DRAFT);
     p = ngtcp2_put_varint(p, version_infolen);
@@ -421,6 +475,70 @@ ngtcp2_ssize ngtcp2_encode_transport_params_versioned(
   return (ngtcp2_ssize)len;
 }
 
+ngtcp2_ssize ngtcp2_encode_transport_params_versioned(
+    uint8_t *dest, size_t destlen, ngtcp2_transport_params_type exttype,
+    int transport_params_version, const ngtcp2_transport_params *params) {
+  (void)transport_params_version;
+
+  return encode_transport_params(dest, destlen, exttype, params, NULL);
+}
+
+void ngtcp2_transport_params_template_init(
+    ngtcp2_transport_params_template *tmpl,
+    const ngtcp2_transport_params *params) {
+  size_t len = static_paramslen(params);
+  uint8_t *p;
+
+  assert(len <= sizeof(tmpl->data));
+
+  tmpl->params = *params;
+  tmpl->params.version_info.other_versions = NULL;
+  tmpl->params.version_info.other_versionslen = 0;
+
+  p = write_static_params(tmpl->data, params);
+  tmpl->datalen = (size_t)(p - tmpl->data);
+
+  assert(tmpl->datalen == len);
+}
+
+/*
+ * static_params_eq returns nonzero if |a| and |b| share the same
+ * transport parameters which do not depend on a particular
+ * connection.
+ */
+static int static_params_eq(const ngtcp2_transport_params *a,
+                            const ngtcp2_transport_params *b) {
+  return a->initial_max_stream_data_bidi_local ==
+             b->initial_max_stream_data_bidi_local &&
+         a->initial_max_stream_data_bidi_remote ==
+             b->initial_max_stream_data_bidi_remote &&
+         a->initial_max_stream_data_uni == b->initial_max_stream_data_uni &&
+         a->initial_max_data == b->initial_max_data &&
+         a->initial_max_streams_bidi == b->initial_max_streams_bidi &&
+         a->initial_max_streams_uni == b->initial_max_streams_uni &&
+         a->max_udp_payload_size == b->max_udp_payload_size &&
+         a->ack_delay_exponent == b->ack_delay_exponent &&
+         a->disable_active_migration == b->disable_active_migration &&
+         a->max_ack_delay == b->max_ack_delay &&
+         a->max_idle_timeout == b->max_idle_timeout &&
+         a->active_connection_id_limit == b->active_connection_id_limit &&
+         a->max_datagram_frame_size == b->max_datagram_frame_size &&
+         a->grease_quic_bit == b->grease_quic_bit &&
+         a->min_ack_delay == b->min_ack_delay &&
+         a->fec_window == b->fec_window;
+}
+
+ngtcp2_ssize ngtcp2_encode_transport_params_template(
+    uint8_t *dest, size_t destlen, ngtcp2_transport_params_type exttype,
+    const ngtcp2_transport_params *params,
+    const ngtcp2_transport_params_template *tmpl) {
+  if (tmpl && !static_params_eq(params, &tmpl->params)) {
+    tmpl = NULL;
+  }
+
+  return encode_transport_params(dest, destlen, exttype, params, tmpl);
+}
+
 /*
  * decode_varint decodes a single varint from the buffer pointed by
  * |p| of length |end - p|.  If it decodes an integer successfully, it
@@ -555,6 +673,8 @@ int ngtcp2_decode_transport_params_versioned(
   memset(&params->initial_scid, 0, sizeof(params->initial_scid));
   memset(&params->original_dcid, 0, sizeof(params->original_dcid));
   params->version_info_present = 0;
+  params->min_ack_delay = 0;
+  params->fec_window = 0;
 
   p = data;
   end = data + datalen;
@@ -784,6 +904,21 @@ int ngtcp2_decode_transport_params_versioned(
       }
       p += nread;
       break;
+    case NGTCP2_TRANSPORT_PARAM_MIN_ACK_DELAY_DRAFT:
+      nread = decode_varint_param(&params->min_ack_delay, p, end);
+      if (nread < 0 || params->min_ack_delay >= (1 << 24)) {
+        return NGTCP2_ERR_MALFORMED_TRANSPORT_PARAM;
+      }
+      params->min_ack_delay *= NGTCP2_MICROSECONDS;
+      p += nread;
+      break;
+    case NGTCP2_TRANSPORT_PARAM_FEC_WINDOW_EXPERIMENTAL:
+      nread = decode_varint_param(&params->fec_window, p, end);
+      if (nread < 0) {
+        return NGTCP2_ERR_MALFORMED_TRANSPORT_PARAM;
+      }
+      p += nread;
+      break;
     case NGTCP2_TRANSPORT_PARAM_GREASE_QUIC_BIT:
       nread = decode_varint(&valuelen, p, end);
       if (nread < 0 || valuelen != 0) {
@@ -842,6 +977,10 @@ int ngtcp2_decode_transport_params_versioned(
     return NGTCP2_ERR_MALFORMED_TRANSPORT_PARAM;
   }
 
+  if (params->min_ack_delay > params->max_ack_delay) {
+    return NGTCP2_ERR_MALFORMED_TRANSPORT_PARAM;
+  }
+
   if (!initial_scid_present ||
       (exttype == NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS &&
        !original_dcid_present)) {
@@ -913,13 +1052,44 @@ void ngtcp2_transport_params_del(ngtcp2_transport_params *params,
   ngtcp2_mem_free(mem, params);
 }
 
-int ngtcp2_transport_params_copy_new(ngtcp2_transport_params **pdest,
-                                     const ngtcp2_transport_params *src,
-                                     const ngtcp2_mem *mem) {
-  if (src == NULL) {
-    *pdest = NULL;
+int ngtcp2_transport_params_storage_copy(ngtcp2_transport_params_storage *st,
+                                         const ngtcp2_transport_params *src,
+                                         const ngtcp2_mem *mem) {
+  const ngtcp2_version_info *vi = &src->version_info;
+  uint8_t *p;
+
+  st->params = *src;
+
+  if (!src->version_info_present || vi->other_versionslen == 0) {
+    st->params.version_info.other_versions = NULL;
+
     return 0;
   }
 
-  return transport_params_copy_new(pdest, src, mem);
+  if (vi->other_versionslen <= sizeof(st->other_versions)) {
+    p = st->other_versions;
+  } else {
+    p = ngtcp2_mem_malloc(mem, vi->other_versionslen);
+    if (p == NULL) {
+      st->params.version_info.other_versions = NULL;
+
+      return NGTCP2_ERR_NOMEM;
+    }
+  }
+
+  memcpy(p, vi->other_versions, vi->other_versionslen);
+  st->params.version_info.other_versions = p;
+
+  return 0;
+}
+
+void ngtcp2_transport_params_storage_free(ngtcp2_transport_params_storage *st,
+                                          const ngtcp2_mem *mem) {
+  uint8_t *p = st->params.version_info.other_versions;
+
+  if (p && p != st->other_versions) {
+    ngtcp2_mem_free(mem, p);
+  }
+
+  st->params.version_info.other_versions = NULL;
 }
@@ -66,6 +66,11 @@ typedef enum ngtcp2_transport_param_id {
   NGTCP2_TRANSPORT_PARAM_GREASE_QUIC_BIT = 0x2ab2,
   /* https://quicwg.org/quic-v2/draft-ietf-quic-v2.html */
   NGTCP2_TRANSPORT_PARAM_VERSION_INFORMATION_DRAFT = 0xff73db,
+  /* https://datatracker.ietf.org/doc/html/draft-ietf-quic-ack-frequency */
+  NGTCP2_TRANSPORT_PARAM_MIN_ACK_DELAY_DRAFT = 0xff04de1b,
+  /* Experimental forward error correction extension.  The codepoint
+     is not registered. */
+  NGTCP2_TRANSPORT_PARAM_FEC_WINDOW_EXPERIMENTAL = 0xff0fec00,
 } ngtcp2_transport_param_id;
 
 /* NGTCP2_CRYPTO_KM_FLAG_NONE indicates that no flag is set. */
@@ -122,17 +127,48 @@ typedef struct ngtcp2_crypto_cc {
   ngtcp2_encrypt encrypt;
   ngtcp2_decrypt decrypt;
   ngtcp2_hp_mask hp_mask;
+  /* encrypt_hp_mask, if not NULL, is used instead of encrypt and
+     hp_mask. */
+  ngtcp2_encrypt_hp_mask encrypt_hp_mask;
+  /* encrypt_vec, if not NULL, lets ngtcp2_ppe refer to STREAM data
+     instead of copying it. */
+  ngtcp2_encrypt_vec encrypt_vec;
 } ngtcp2_crypto_cc;
 
+/*
+ * ngtcp2_encode_transport_params_template is similar to
+ * ngtcp2_encode_transport_params, but it copies the transport
+ * parameters which do not depend on a particular connection from
+ * |tmpl| if |tmpl| is not NULL, and they match |params|.
+ */
+ngtcp2_ssize ngtcp2_encode_transport_params_template(
+    uint8_t *dest, size_t destlen, ngtcp2_transport_params_type exttype,
+    const ngtcp2_transport_params *params,
+    const ngtcp2_transport_params_template *tmpl);
+
 void ngtcp2_crypto_create_nonce(uint8_t *dest, const uint8_t *iv, size_t ivlen,
                                 int64_t pkt_num);
 
+/* NGTCP2_TRANSPORT_PARAMS_STORAGE_OTHER_VERSIONSLEN is the length of
+   version_info.other_versions that ngtcp2_transport_params_storage
+   can hold without allocating memory. */
+#define NGTCP2_TRANSPORT_PARAMS_STORAGE_OTHER_VERSIONSLEN 32
+
 /*
- * ngtcp2_transport_params_copy_new makes a copy of |src|, and assigns
- * it to |*pdest|.  If |src| is NULL, NULL is assigned to |*pdest|.
- *
- * Caller is responsible to call ngtcp2_transport_params_del to free
- * the memory assigned to |*pdest|.
+ * ngtcp2_transport_params_storage holds a copy of transport
+ * parameters, and its variable length fields in place.
+ */
+typedef struct ngtcp2_transport_params_storage {
+  ngtcp2_transport_params params;
+  uint8_t other_versions[NGTCP2_TRANSPORT_PARAMS_STORAGE_OTHER_VERSIONSLEN];
+} ngtcp2_transport_params_storage;
+
+/*
+ * ngtcp2_transport_params_storage_copy copies |src| to |st|.
+ * version_info.other_versions is copied to st->other_versions if it
+ * fits in.  Otherwise, it is allocated by |mem|.  |st| must not hold
+ * the transport parameters, that is, it must be zero cleared or
+ * freed by ngtcp2_transport_params_storage_free.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -140,8 +176,15 @@ void ngtcp2_crypto_create_nonce(uint8_t *dest, const uint8_t *iv, size_t ivlen,
  * NGTCP2_ERR_NOMEM
  *     Out of memory.
  */
-int ngtcp2_transport_params_copy_new(ngtcp2_transport_params **pdest,
-                                     const ngtcp2_transport_params *src,
-                                     const ngtcp2_mem *mem);
+int ngtcp2_transport_params_storage_copy(ngtcp2_transport_params_storage *st,
+                                         const ngtcp2_transport_params *src,
+                                         const ngtcp2_mem *mem);
+
+/*
+ * ngtcp2_transport_params_storage_free frees the memory which
+ * ngtcp2_transport_params_storage_copy allocated for |st|.
+ */
+void ngtcp2_transport_params_storage_free(ngtcp2_transport_params_storage *st,
+                                          const ngtcp2_mem *mem);
 
 #endif /* NGTCP2_CRYPTO_H */
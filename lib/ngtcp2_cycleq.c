@@ -0,0 +1,285 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_cycleq.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "ngtcp2_macro.h"
+
+void ngtcp2_cycleq_init(ngtcp2_cycleq *cq, ngtcp2_cycleq_cycle cycle_of,
+                        ngtcp2_less less, const ngtcp2_mem *mem) {
+  size_t i;
+  ngtcp2_cycleq_bucket *b;
+
+  for (i = 0; i < 2; ++i) {
+    b = &cq->buckets[i];
+    b->q = NULL;
+    b->head = 0;
+    b->len = 0;
+    b->capacity = 0;
+    ngtcp2_pq_init(&b->spill, less, mem);
+  }
+
+  cq->mem = mem;
+  cq->cycle_of = cycle_of;
+  cq->less = less;
+  cq->cycle = 0;
+  cq->cur = 0;
+  cq->length = 0;
+}
+
+void ngtcp2_cycleq_free(ngtcp2_cycleq *cq) {
+  size_t i;
+
+  for (i = 0; i < 2; ++i) {
+    ngtcp2_pq_free(&cq->buckets[i].spill);
+    ngtcp2_mem_free(cq->mem, cq->buckets[i].q);
+    cq->buckets[i].q = NULL;
+  }
+}
+
+/*
+ * bucket_set stores |item| at |pos| of the sorted items of the bucket
+ * |idx|.
+ */
+static void bucket_set(ngtcp2_cycleq *cq, size_t idx, size_t pos,
+                       ngtcp2_pq_entry *item) {
+  cq->buckets[idx].q[pos] = item;
+  item->index = (pos << 1) | idx;
+}
+
+/*
+ * bucket_has_sorted returns nonzero if |item| is one of the sorted
+ * items of |b|.
+ */
+static int bucket_has_sorted(const ngtcp2_cycleq_bucket *b,
+                             const ngtcp2_pq_entry *item) {
+  size_t pos = item->index >> 1;
+
+  return pos >= b->head && pos < b->len && b->q[pos] == item;
+}
+
+/*
+ * bucket_has_spill returns nonzero if |item| is in the heap of |b|.
+ */
+static int bucket_has_spill(const ngtcp2_cycleq_bucket *b,
+                            const ngtcp2_pq_entry *item) {
+  return item->index < b->spill.length && b->spill.q[item->index] == item;
+}
+
+/*
+ * bucket_empty returns nonzero if |b| has no item.
+ */
+static int bucket_empty(const ngtcp2_cycleq_bucket *b) {
+  return b->head == b->len && b->spill.length == 0;
+}
+
+/*
+ * bucket_top_spill returns nonzero if the first item of |b| is in
+ * the heap.  |b| must not be empty.
+ */
+static int bucket_top_spill(ngtcp2_cycleq *cq, ngtcp2_cycleq_bucket *b) {
+  if (b->spill.length == 0) {
+    return 0;
+  }
+
+  return b->head == b->len ||
+         cq->less(ngtcp2_pq_top(&b->spill), b->q[b->head]);
+}
+
+/*
+ * bucket_append appends |item| to the sorted items of the bucket
+ * |idx|.
+ */
+static int bucket_append(ngtcp2_cycleq *cq, size_t idx,
+                         ngtcp2_pq_entry *item) {
+  ngtcp2_cycleq_bucket *b = &cq->buckets[idx];
+  size_t i, j, ncapacity;
+  void *nq;
+
+  if (b->len == b->capacity) {
+    if (b->head) {
+      for (i = b->head, j = 0; i < b->len; ++i) {
+        if (b->q[i]) {
+          bucket_set(cq, idx, j++, b->q[i]);
+        }
+      }
+
+      b->head = 0;
+      b->len = j;
+    }
+
+    if (b->len == b->capacity || b->len * 2 > b->capacity) {
+      ncapacity = ngtcp2_max(4, b->capacity * 2);
+
+      nq = ngtcp2_mem_realloc(cq->mem, b->q,
+                              ncapacity * sizeof(ngtcp2_pq_entry *));
+      if (nq == NULL) {
+        return NGTCP2_ERR_NOMEM;
+      }
+
+      b->q = nq;
+      b->capacity = ncapacity;
+    }
+  }
+
+  bucket_set(cq, idx, b->len++, item);
+
+  return 0;
+}
+
+/*
+ * bucket_skip_holes advances the head of |b| past the removed items.
+ */
+static void bucket_skip_holes(ngtcp2_cycleq_bucket *b) {
+  for (; b->head < b->len && b->q[b->head] == NULL; ++b->head)
+    ;
+
+  if (b->head == b->len) {
+    b->head = b->len = 0;
+  }
+}
+
+/*
+ * cycleq_settle makes the other bucket current if the bucket of the
+ * top has become empty.
+ */
+static void cycleq_settle(ngtcp2_cycleq *cq) {
+  if (cq->length && bucket_empty(&cq->buckets[cq->cur])) {
+    cq->cur ^= 1;
+    ++cq->cycle;
+  }
+}
+
+int ngtcp2_cycleq_push(ngtcp2_cycleq *cq, ngtcp2_pq_entry *item) {
+  uint64_t cycle = cq->cycle_of(item);
+  ngtcp2_cycleq_bucket *b;
+  size_t idx;
+  int rv;
+
+  if (cq->length == 0) {
+    cq->cycle = cycle;
+    idx = cq->cur;
+  } else if (cycle == cq->cycle) {
+    idx = cq->cur;
+  } else {
+    assert(cycle == cq->cycle + 1);
+    idx = cq->cur ^ 1;
+  }
+
+  b = &cq->buckets[idx];
+
+  if (b->head == b->len || !cq->less(item, b->q[b->len - 1])) {
+    rv = bucket_append(cq, idx, item);
+  } else if (b->head && cq->less(item, b->q[b->head])) {
+    bucket_set(cq, idx, --b->head, item);
+    rv = 0;
+  } else {
+    rv = ngtcp2_pq_push(&b->spill, item);
+  }
+
+  if (rv != 0) {
+    return rv;
+  }
+
+  ++cq->length;
+
+  return 0;
+}
+
+ngtcp2_pq_entry *ngtcp2_cycleq_top(ngtcp2_cycleq *cq) {
+  ngtcp2_cycleq_bucket *b = &cq->buckets[cq->cur];
+
+  assert(cq->length);
+
+  if (bucket_top_spill(cq, b)) {
+    return ngtcp2_pq_top(&b->spill);
+  }
+
+  return b->q[b->head];
+}
+
+void ngtcp2_cycleq_pop(ngtcp2_cycleq *cq) {
+  ngtcp2_cycleq_bucket *b = &cq->buckets[cq->cur];
+
+  assert(cq->length);
+
+  if (bucket_top_spill(cq, b)) {
+    ngtcp2_pq_pop(&b->spill);
+  } else {
+    b->q[b->head++] = NULL;
+    bucket_skip_holes(b);
+  }
+
+  --cq->length;
+
+  cycleq_settle(cq);
+}
+
+void ngtcp2_cycleq_remove(ngtcp2_cycleq *cq, ngtcp2_pq_entry *item) {
+  ngtcp2_cycleq_bucket *b;
+  size_t i, pos;
+
+  --cq->length;
+
+  for (i = 0; i < 2; ++i) {
+    b = &cq->buckets[i];
+
+    if (bucket_has_sorted(b, item)) {
+      pos = item->index >> 1;
+      b->q[pos] = NULL;
+
+      if (pos == b->head) {
+        bucket_skip_holes(b);
+      } else {
+        for (; b->q[b->len - 1] == NULL; --b->len)
+          ;
+      }
+
+      cycleq_settle(cq);
+
+      return;
+    }
+  }
+
+  for (i = 0; i < 2; ++i) {
+    b = &cq->buckets[i];
+
+    if (bucket_has_spill(b, item)) {
+      ngtcp2_pq_remove(&b->spill, item);
+
+      cycleq_settle(cq);
+
+      return;
+    }
+  }
+
+  assert(0);
+}
+
+int ngtcp2_cycleq_empty(const ngtcp2_cycleq *cq) { return cq->length == 0; }
+
+size_t ngtcp2_cycleq_size(const ngtcp2_cycleq *cq) { return cq->length; }
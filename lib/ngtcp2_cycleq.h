@@ -0,0 +1,135 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGTCP2_CYCLEQ_H
+#define NGTCP2_CYCLEQ_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <ngtcp2/ngtcp2.h>
+
+#include "ngtcp2_pq.h"
+#include "ngtcp2_mem.h"
+
+/* ngtcp2_cycleq_cycle returns the cycle of the item |ent|. */
+typedef uint64_t (*ngtcp2_cycleq_cycle)(const ngtcp2_pq_entry *ent);
+
+/*
+ * ngtcp2_cycleq_bucket holds the items of the same cycle.  The items
+ * pushed in order of the less function are stored in q[head..len)
+ * which is sorted.  An item which is removed from the middle of it
+ * leaves NULL.  The other items are stored in spill.
+ */
+typedef struct ngtcp2_cycleq_bucket {
+  ngtcp2_pq_entry **q;
+  size_t head;
+  size_t len;
+  size_t capacity;
+  ngtcp2_pq spill;
+} ngtcp2_cycleq_bucket;
+
+/*
+ * ngtcp2_cycleq is a priority queue specialized for round-robin
+ * which orders items by cycle first, and then by the less function.
+ * The cycle of an item is incremented when it is served, and an item
+ * newly added takes the cycle of the item at the top.  Thus, all
+ * items are in either the cycle of the top, or the next one, and
+ * ngtcp2_cycleq keeps them in 2 buckets.  Items served in order are
+ * pushed back to the next bucket in order, so that serving the top,
+ * and pushing it back with the next cycle are O(1).  An item pushed
+ * out of order goes to the binary heap of its bucket.
+ *
+ * It uses ngtcp2_pq_entry so that an item can tell whether it is
+ * queued by the same way as ngtcp2_pq.
+ */
+typedef struct ngtcp2_cycleq {
+  ngtcp2_cycleq_bucket buckets[2];
+  const ngtcp2_mem *mem;
+  /* cycle_of returns the cycle of an item. */
+  ngtcp2_cycleq_cycle cycle_of;
+  /* less orders the items in the same cycle. */
+  ngtcp2_less less;
+  /* cycle is the cycle of buckets[cur]. */
+  uint64_t cycle;
+  /* cur is the index of the bucket which contains the top. */
+  size_t cur;
+  /* length is the number of items stored. */
+  size_t length;
+} ngtcp2_cycleq;
+
+/*
+ * ngtcp2_cycleq_init initializes |cq|.
+ */
+void ngtcp2_cycleq_init(ngtcp2_cycleq *cq, ngtcp2_cycleq_cycle cycle_of,
+                        ngtcp2_less less, const ngtcp2_mem *mem);
+
+/*
+ * ngtcp2_cycleq_free frees resources allocated for |cq|.  The stored
+ * items are not freed by this function.
+ */
+void ngtcp2_cycleq_free(ngtcp2_cycleq *cq);
+
+/*
+ * ngtcp2_cycleq_push adds |item| to |cq|.  If |cq| is not empty, the
+ * cycle of |item| must be equal to the cycle of the top, or larger
+ * than it by one.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ */
+int ngtcp2_cycleq_push(ngtcp2_cycleq *cq, ngtcp2_pq_entry *item);
+
+/*
+ * ngtcp2_cycleq_top returns the item at the top of |cq|.  |cq| must
+ * not be empty.
+ */
+ngtcp2_pq_entry *ngtcp2_cycleq_top(ngtcp2_cycleq *cq);
+
+/*
+ * ngtcp2_cycleq_pop removes the item at the top of |cq|.  |cq| must
+ * not be empty.
+ */
+void ngtcp2_cycleq_pop(ngtcp2_cycleq *cq);
+
+/*
+ * ngtcp2_cycleq_remove removes |item| from |cq|.
+ */
+void ngtcp2_cycleq_remove(ngtcp2_cycleq *cq, ngtcp2_pq_entry *item);
+
+/*
+ * ngtcp2_cycleq_empty returns nonzero if |cq| is empty.
+ */
+int ngtcp2_cycleq_empty(const ngtcp2_cycleq *cq);
+
+/*
+ * ngtcp2_cycleq_size returns the number of items in |cq|.
+ */
+size_t ngtcp2_cycleq_size(const ngtcp2_cycleq *cq);
+
+#endif /* NGTCP2_CYCLEQ_H */
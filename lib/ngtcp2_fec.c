@@ -0,0 +1,194 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_fec.h"
+
+#include <string.h>
+#include <assert.h>
+
+#include "ngtcp2_macro.h"
+#include "ngtcp2_mem.h"
+#include "ngtcp2_cpu.h"
+
+void ngtcp2_fec_enc_init(ngtcp2_fec_enc *enc, size_t max_symbolcnt) {
+  assert(max_symbolcnt);
+  assert(max_symbolcnt <= NGTCP2_MAX_FEC_SYMBOLCNT);
+
+  enc->max_symbolcnt = max_symbolcnt;
+  enc->offset = 0;
+  enc->symbolcnt = 0;
+  enc->repairlen = 0;
+}
+
+void ngtcp2_fec_enc_add(ngtcp2_fec_enc *enc, uint64_t offset,
+                        const ngtcp2_vec *data, size_t datacnt) {
+  size_t i, n;
+  size_t len = 0;
+  uint8_t *p;
+
+  assert(enc->symbolcnt < enc->max_symbolcnt);
+
+  if (enc->symbolcnt == 0) {
+    enc->offset = offset;
+  } else {
+    assert(enc->offset + ngtcp2_fec_enc_span(enc) == offset);
+  }
+
+  p = enc->repair;
+
+  for (i = 0; i < datacnt; ++i) {
+    assert(len + data[i].len <= NGTCP2_MAX_FEC_SYMBOLLEN);
+
+    /* XOR the part which overlaps the repair symbol so far, and copy
+       the rest. */
+    n = len < enc->repairlen ? ngtcp2_min(data[i].len, enc->repairlen - len)
+                             : 0;
+
+    ngtcp2_cpu_memxor(p, data[i].base, n);
+
+    if (n < data[i].len) {
+      memcpy(p + n, data[i].base + n, data[i].len - n);
+    }
+
+    p += data[i].len;
+    len += data[i].len;
+  }
+
+  assert(len);
+
+  enc->repairlen = ngtcp2_max(enc->repairlen, len);
+  enc->symbollen[enc->symbolcnt++] = (uint16_t)len;
+}
+
+int ngtcp2_fec_enc_full(const ngtcp2_fec_enc *enc) {
+  return enc->symbolcnt == enc->max_symbolcnt;
+}
+
+uint64_t ngtcp2_fec_enc_span(const ngtcp2_fec_enc *enc) {
+  uint64_t span = 0;
+  size_t i;
+
+  for (i = 0; i < enc->symbolcnt; ++i) {
+    span += enc->symbollen[i];
+  }
+
+  return span;
+}
+
+void ngtcp2_fec_enc_write_repair(ngtcp2_fec_enc *enc, ngtcp2_repair *fr,
+                                 int64_t stream_id, uint8_t *dest) {
+  assert(enc->symbolcnt);
+
+  fr->type = NGTCP2_FRAME_REPAIR;
+  fr->stream_id = stream_id;
+  fr->offset = enc->offset;
+  fr->symbolcnt = enc->symbolcnt;
+  memcpy(fr->symbollen, enc->symbollen,
+         sizeof(enc->symbollen[0]) * enc->symbolcnt);
+
+  memcpy(dest, enc->repair, enc->repairlen);
+  fr->data.base = dest;
+  fr->data.len = enc->repairlen;
+
+  enc->symbolcnt = 0;
+  enc->repairlen = 0;
+}
+
+int ngtcp2_fec_rxbuf_new(ngtcp2_fec_rxbuf **prxbuf, size_t cap,
+                         uint64_t offset, const ngtcp2_mem *mem) {
+  ngtcp2_fec_rxbuf *rxbuf;
+
+  assert(cap);
+
+  rxbuf = ngtcp2_mem_malloc(mem, sizeof(ngtcp2_fec_rxbuf) + cap);
+  if (rxbuf == NULL) {
+    return NGTCP2_ERR_NOMEM;
+  }
+
+  rxbuf->buf = (uint8_t *)rxbuf + sizeof(ngtcp2_fec_rxbuf);
+  rxbuf->cap = cap;
+  rxbuf->low = offset;
+  rxbuf->high = offset;
+
+  *prxbuf = rxbuf;
+
+  return 0;
+}
+
+void ngtcp2_fec_rxbuf_del(ngtcp2_fec_rxbuf *rxbuf, const ngtcp2_mem *mem) {
+  ngtcp2_mem_free(mem, rxbuf);
+}
+
+void ngtcp2_fec_rxbuf_store(ngtcp2_fec_rxbuf *rxbuf, uint64_t offset,
+                            const uint8_t *data, size_t datalen) {
+  uint64_t end = offset + datalen;
+  size_t pos, n;
+
+  if (end > rxbuf->high) {
+    rxbuf->high = end;
+
+    if (end > rxbuf->cap) {
+      rxbuf->low = ngtcp2_max(rxbuf->low, end - rxbuf->cap);
+    }
+  }
+
+  if (end <= rxbuf->low) {
+    return;
+  }
+
+  if (offset < rxbuf->low) {
+    data += rxbuf->low - offset;
+    offset = rxbuf->low;
+  }
+
+  for (; offset < end;) {
+    pos = (size_t)(offset % rxbuf->cap);
+    n = (size_t)ngtcp2_min(end - offset, rxbuf->cap - pos);
+
+    memcpy(rxbuf->buf + pos, data, n);
+
+    data += n;
+    offset += n;
+  }
+}
+
+int ngtcp2_fec_rxbuf_retains(const ngtcp2_fec_rxbuf *rxbuf, uint64_t offset,
+                             size_t datalen) {
+  return offset >= rxbuf->low && offset + datalen <= rxbuf->high;
+}
+
+void ngtcp2_fec_rxbuf_xor(const ngtcp2_fec_rxbuf *rxbuf, uint8_t *dest,
+                          uint64_t offset, size_t datalen) {
+  size_t pos, n;
+
+  assert(ngtcp2_fec_rxbuf_retains(rxbuf, offset, datalen));
+
+  /* The retained data spans at most cap bytes, so that it wraps
+     around the buffer at most once. */
+  pos = (size_t)(offset % rxbuf->cap);
+  n = ngtcp2_min(datalen, rxbuf->cap - pos);
+
+  ngtcp2_cpu_memxor(dest, rxbuf->buf + pos, n);
+  ngtcp2_cpu_memxor(dest + n, rxbuf->buf, datalen - n);
+}
@@ -0,0 +1,161 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGTCP2_FEC_H
+#define NGTCP2_FEC_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <ngtcp2/ngtcp2.h>
+
+#include "ngtcp2_pkt.h"
+
+/* NGTCP2_FEC_REPAIR_OVERHEAD is the maximum number of bytes that
+   REPAIR frame needs in addition to its repair data. */
+#define NGTCP2_FEC_REPAIR_OVERHEAD                                             \
+  (2 + 8 + 8 + 1 + NGTCP2_MAX_FEC_SYMBOLCNT * 2)
+
+/*
+ * ngtcp2_fec_enc computes the repair data of a group of consecutive
+ * STREAM frames sent to a stream.  Each STREAM frame is a source
+ * symbol, and the repair data is XOR of all source symbols, each of
+ * which is padded with zeros to the longest one.
+ */
+typedef struct ngtcp2_fec_enc {
+  /* max_symbolcnt is the number of source symbols after which the
+     group is complete. */
+  size_t max_symbolcnt;
+  /* offset is the stream offset of the first source symbol. */
+  uint64_t offset;
+  /* symbolcnt is the number of source symbols in the group. */
+  size_t symbolcnt;
+  /* symbollen contains the length of each source symbol. */
+  uint16_t symbollen[NGTCP2_MAX_FEC_SYMBOLCNT];
+  /* repairlen is the length of the longest source symbol. */
+  size_t repairlen;
+  uint8_t repair[NGTCP2_MAX_FEC_SYMBOLLEN];
+} ngtcp2_fec_enc;
+
+/*
+ * ngtcp2_fec_enc_init initializes |enc| which completes a group
+ * after |max_symbolcnt| source symbols.  |max_symbolcnt| must be in
+ * the range [1, NGTCP2_MAX_FEC_SYMBOLCNT].
+ */
+void ngtcp2_fec_enc_init(ngtcp2_fec_enc *enc, size_t max_symbolcnt);
+
+/*
+ * ngtcp2_fec_enc_add adds the data of STREAM frame at |offset| to
+ * the current group.  The data are |datacnt| vectors pointed by
+ * |data|, and their length must be in the range [1,
+ * NGTCP2_MAX_FEC_SYMBOLLEN].  |offset| must be the end of the
+ * previous source symbol unless the group is empty.  The group must
+ * not be full.
+ */
+void ngtcp2_fec_enc_add(ngtcp2_fec_enc *enc, uint64_t offset,
+                        const ngtcp2_vec *data, size_t datacnt);
+
+/*
+ * ngtcp2_fec_enc_full returns nonzero if the current group is
+ * complete.
+ */
+int ngtcp2_fec_enc_full(const ngtcp2_fec_enc *enc);
+
+/*
+ * ngtcp2_fec_enc_span returns the number of bytes of stream data
+ * that the current group covers.
+ */
+uint64_t ngtcp2_fec_enc_span(const ngtcp2_fec_enc *enc);
+
+/*
+ * ngtcp2_fec_enc_write_repair fills |fr| with REPAIR frame of the
+ * current group for a stream denoted by |stream_id|, and starts a
+ * new group.  The repair data are copied to |dest| which must be at
+ * least enc->repairlen bytes long.  The group must not be empty.
+ */
+void ngtcp2_fec_enc_write_repair(ngtcp2_fec_enc *enc, ngtcp2_repair *fr,
+                                 int64_t stream_id, uint8_t *dest);
+
+/*
+ * ngtcp2_fec_rxbuf retains the most recently received stream data so
+ * that a lost STREAM frame can be reconstructed from REPAIR frame
+ * after the other source symbols have been delivered to an
+ * application.  The byte at stream offset o is stored at buf[o %
+ * cap].
+ */
+typedef struct ngtcp2_fec_rxbuf {
+  uint8_t *buf;
+  /* cap is the capacity of buf. */
+  size_t cap;
+  /* low is the smallest stream offset that might be retained. */
+  uint64_t low;
+  /* high is the largest stream offset of the stored data. */
+  uint64_t high;
+} ngtcp2_fec_rxbuf;
+
+/*
+ * ngtcp2_fec_rxbuf_new allocates ngtcp2_fec_rxbuf which retains at
+ * most |cap| bytes, and assigns its pointer to |*prxbuf|.  The
+ * retention starts at stream offset |offset|.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ */
+int ngtcp2_fec_rxbuf_new(ngtcp2_fec_rxbuf **prxbuf, size_t cap,
+                         uint64_t offset, const ngtcp2_mem *mem);
+
+/*
+ * ngtcp2_fec_rxbuf_del frees |rxbuf|.
+ */
+void ngtcp2_fec_rxbuf_del(ngtcp2_fec_rxbuf *rxbuf, const ngtcp2_mem *mem);
+
+/*
+ * ngtcp2_fec_rxbuf_store stores |datalen| bytes of stream data
+ * pointed by |data| at stream offset |offset|.  The bytes which are
+ * too old to be retained are ignored.
+ */
+void ngtcp2_fec_rxbuf_store(ngtcp2_fec_rxbuf *rxbuf, uint64_t offset,
+                            const uint8_t *data, size_t datalen);
+
+/*
+ * ngtcp2_fec_rxbuf_retains returns nonzero if |rxbuf| still has the
+ * range [|offset|, |offset| + |datalen|).  It does not tell whether
+ * the data in the range have been actually stored.  The caller has
+ * to check that they have been received.
+ */
+int ngtcp2_fec_rxbuf_retains(const ngtcp2_fec_rxbuf *rxbuf, uint64_t offset,
+                             size_t datalen);
+
+/*
+ * ngtcp2_fec_rxbuf_xor performs XOR of |datalen| bytes retained at
+ * stream offset |offset| into |dest|.  The range must be retained.
+ */
+void ngtcp2_fec_rxbuf_xor(const ngtcp2_fec_rxbuf *rxbuf, uint8_t *dest,
+                          uint64_t offset, size_t datalen);
+
+#endif /* NGTCP2_FEC_H */
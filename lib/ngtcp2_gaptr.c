@@ -54,6 +54,8 @@ void ngtcp2_gaptr_free(ngtcp2_gaptr *gaptr) {
   ngtcp2_ksl_free(&gaptr->gap);
 }
 
+void ngtcp2_gaptr_clear(ngtcp2_gaptr *gaptr) { ngtcp2_ksl_reset(&gaptr->gap); }
+
 int ngtcp2_gaptr_push(ngtcp2_gaptr *gaptr, uint64_t offset, uint64_t datalen) {
   int rv;
   ngtcp2_range k, m, l, r, q = {offset, offset + datalen};
@@ -56,6 +56,12 @@ void ngtcp2_gaptr_init(ngtcp2_gaptr *gaptr, const ngtcp2_mem *mem);
  */
 void ngtcp2_gaptr_free(ngtcp2_gaptr *gaptr);
 
+/*
+ * ngtcp2_gaptr_clear makes |gaptr| as if nothing is pushed to it.  It
+ * keeps the memory of its internal structure.
+ */
+void ngtcp2_gaptr_clear(ngtcp2_gaptr *gaptr);
+
 /*
  * ngtcp2_gaptr_push adds new data of length |datalen| at the stream
  * offset |offset|.
@@ -25,10 +25,22 @@
 #include "ngtcp2_idtr.h"
 
 #include <assert.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#endif
+
+#include "ngtcp2_macro.h"
+
+#define NGTCP2_IDTR_WINDOW_WORDS (NGTCP2_IDTR_WINDOW_BITS / 64)
 
 void ngtcp2_idtr_init(ngtcp2_idtr *idtr, int server, const ngtcp2_mem *mem) {
   ngtcp2_gaptr_init(&idtr->gap, mem);
 
+  idtr->base = 0;
+  memset(idtr->window, 0, sizeof(idtr->window));
+
   idtr->server = server;
 }
 
@@ -48,6 +60,149 @@ static uint64_t id_from_stream_id(int64_t stream_id) {
   return (uint64_t)(stream_id >> 2);
 }
 
+/*
+ * ctz64 returns the number of trailing zero bits in |n|.  |n| must
+ * not be 0.
+ */
+static uint64_t ctz64(uint64_t n) {
+#if defined(_MSC_VER)
+  unsigned long index;
+#  if defined(_M_X64) || defined(_M_ARM64)
+  _BitScanForward64(&index, n);
+  return index;
+#  else
+  if ((uint32_t)n != 0) {
+    _BitScanForward(&index, (unsigned long)n);
+    return index;
+  }
+
+  _BitScanForward(&index, (unsigned long)(n >> 32));
+  return 32 + index;
+#  endif
+#else
+  return (uint64_t)__builtin_ctzll(n);
+#endif
+}
+
+static int window_isset(const ngtcp2_idtr *idtr, uint64_t i) {
+  return (idtr->window[i / 64] >> (i % 64)) & 1;
+}
+
+static void window_set(ngtcp2_idtr *idtr, uint64_t i) {
+  idtr->window[i / 64] |= 1ULL << (i % 64);
+}
+
+/*
+ * window_count_used returns the number of consecutive used IDs in
+ * the window, starting at idtr->base.
+ */
+static uint64_t window_count_used(const ngtcp2_idtr *idtr) {
+  size_t i;
+  uint64_t n = 0;
+
+  for (i = 0; i < NGTCP2_IDTR_WINDOW_WORDS; ++i) {
+    if (idtr->window[i] != UINT64_MAX) {
+      return n + ctz64(~idtr->window[i]);
+    }
+
+    n += 64;
+  }
+
+  return n;
+}
+
+/*
+ * window_shift drops the first |n| bits of the window.
+ */
+static void window_shift(ngtcp2_idtr *idtr, uint64_t n) {
+  size_t s, b, i;
+
+  if (n >= NGTCP2_IDTR_WINDOW_BITS) {
+    memset(idtr->window, 0, sizeof(idtr->window));
+    return;
+  }
+
+  s = (size_t)(n / 64);
+  b = (size_t)(n % 64);
+
+  for (i = 0; i + s < NGTCP2_IDTR_WINDOW_WORDS; ++i) {
+    idtr->window[i] = idtr->window[i + s] >> b;
+    if (b && i + s + 1 < NGTCP2_IDTR_WINDOW_WORDS) {
+      idtr->window[i] |= idtr->window[i + s + 1] << (64 - b);
+    }
+  }
+
+  for (; i < NGTCP2_IDTR_WINDOW_WORDS; ++i) {
+    idtr->window[i] = 0;
+  }
+}
+
+/*
+ * window_fill sets the bits of the IDs in [|offset|, idtr->base +
+ * NGTCP2_IDTR_WINDOW_BITS) which have been pushed to idtr->gap.
+ */
+static void window_fill(ngtcp2_idtr *idtr, uint64_t offset) {
+  uint64_t end = idtr->base + NGTCP2_IDTR_WINDOW_BITS;
+  ngtcp2_range r;
+
+  for (; offset < end;) {
+    r = ngtcp2_gaptr_get_first_gap_after(&idtr->gap, offset);
+
+    for (; offset < r.begin && offset < end; ++offset) {
+      window_set(idtr, offset - idtr->base);
+    }
+
+    offset = r.end;
+  }
+}
+
+/*
+ * idtr_slide advances idtr->base past the used IDs, so that
+ * idtr->base is the first unused ID.
+ */
+static void idtr_slide(ngtcp2_idtr *idtr) {
+  uint64_t n, end;
+  ngtcp2_range r;
+
+  for (;;) {
+    n = window_count_used(idtr);
+    if (n == 0) {
+      if (ngtcp2_ksl_len(&idtr->gap.gap) == 0) {
+        return;
+      }
+
+      r = ngtcp2_gaptr_get_first_gap_after(&idtr->gap, idtr->base);
+      if (r.begin <= idtr->base) {
+        return;
+      }
+
+      n = r.begin - idtr->base;
+    }
+
+    end = idtr->base + NGTCP2_IDTR_WINDOW_BITS;
+
+    window_shift(idtr, n);
+    idtr->base += n;
+
+    if (ngtcp2_ksl_len(&idtr->gap.gap)) {
+      window_fill(idtr, ngtcp2_max(end, idtr->base));
+    }
+  }
+}
+
+static int idtr_is_open(ngtcp2_idtr *idtr, uint64_t q) {
+  if (q < idtr->base) {
+    return 1;
+  }
+
+  if (q - idtr->base < NGTCP2_IDTR_WINDOW_BITS &&
+      window_isset(idtr, q - idtr->base)) {
+    return 1;
+  }
+
+  return ngtcp2_gaptr_is_pushed(&idtr->gap, q, 1);
+}
+
 int ngtcp2_idtr_open(ngtcp2_idtr *idtr, int64_t stream_id) {
   uint64_t q;
 
@@ -56,11 +211,27 @@ int ngtcp2_idtr_open(ngtcp2_idtr *idtr, int64_t stream_id) {
 
   q = id_from_stream_id(stream_id);
 
-  if (ngtcp2_gaptr_is_pushed(&idtr->gap, q, 1)) {
+  if (idtr_is_open(idtr, q)) {
     return NGTCP2_ERR_STREAM_IN_USE;
   }
 
-  return ngtcp2_gaptr_push(&idtr->gap, q, 1);
+  if (q - idtr->base >= NGTCP2_IDTR_WINDOW_BITS) {
+    /* The IDs restored from a snapshot are only in gap.  Sliding
+       here brings the window to them. */
+    idtr_slide(idtr);
+
+    if (q - idtr->base >= NGTCP2_IDTR_WINDOW_BITS) {
+      return ngtcp2_gaptr_push(&idtr->gap, q, 1);
+    }
+  }
+
+  window_set(idtr, q - idtr->base);
+
+  if (q == idtr->base) {
+    idtr_slide(idtr);
+  }
+
+  return 0;
 }
 
 int ngtcp2_idtr_is_open(ngtcp2_idtr *idtr, int64_t stream_id) {
@@ -71,9 +242,42 @@ int ngtcp2_idtr_is_open(ngtcp2_idtr *idtr, int64_t stream_id) {
 
   q = id_from_stream_id(stream_id);
 
-  return ngtcp2_gaptr_is_pushed(&idtr->gap, q, 1);
+  return idtr_is_open(idtr, q);
 }
 
 uint64_t ngtcp2_idtr_first_gap(ngtcp2_idtr *idtr) {
-  return ngtcp2_gaptr_first_gap_offset(&idtr->gap);
+  idtr_slide(idtr);
+
+  return idtr->base;
+}
+
+int ngtcp2_idtr_sync_gap(ngtcp2_idtr *idtr) {
+  uint64_t i, j;
+  int rv;
+
+  if (idtr->base) {
+    rv = ngtcp2_gaptr_push(&idtr->gap, 0, idtr->base);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  for (i = 0; i < NGTCP2_IDTR_WINDOW_BITS;) {
+    if (!window_isset(idtr, i)) {
+      ++i;
+      continue;
+    }
+
+    for (j = i + 1; j < NGTCP2_IDTR_WINDOW_BITS && window_isset(idtr, j); ++j)
+      ;
+
+    rv = ngtcp2_gaptr_push(&idtr->gap, idtr->base + i, j - i);
+    if (rv != 0) {
+      return rv;
+    }
+
+    i = j;
+  }
+
+  return 0;
 }
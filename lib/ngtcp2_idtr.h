@@ -34,13 +34,34 @@
 #include "ngtcp2_mem.h"
 #include "ngtcp2_gaptr.h"
 
+/*
+ * NGTCP2_IDTR_WINDOW_BITS is the number of IDs which ngtcp2_idtr
+ * tracks with a bitmap.
+ */
+#define NGTCP2_IDTR_WINDOW_BITS 256
+
 /*
  * ngtcp2_idtr tracks the usage of stream ID.
+ *
+ * IDs are usually opened in roughly increasing order.  The IDs below
+ * |base| are all used, and the usage of the next
+ * NGTCP2_IDTR_WINDOW_BITS IDs is recorded in |window|.  Only the IDs
+ * that are beyond the window are recorded in |gap|, which allocates
+ * memory.  The window slides forward as its first ID is used.
  */
 typedef struct ngtcp2_idtr {
   /* gap maintains the range of ID which is not used yet. Initially,
-     its range is [0, UINT64_MAX). */
+     its range is [0, UINT64_MAX).  An ID is used if it is below
+     base, if its bit in window is set, or if it has been pushed to
+     gap. */
   ngtcp2_gaptr gap;
+  /* base is the first ID of window.  All IDs less than base have
+     been used. */
+  uint64_t base;
+  /* window is the bitmap of the IDs in [base, base +
+     NGTCP2_IDTR_WINDOW_BITS).  The ID base + i is used if the bit (i
+     % 64) of window[i / 64] is set. */
+  uint64_t window[NGTCP2_IDTR_WINDOW_BITS / 64];
   /* server is nonzero if this object records server initiated stream
      ID. */
   int server;
@@ -86,4 +107,17 @@ int ngtcp2_idtr_is_open(ngtcp2_idtr *idtr, int64_t stream_id);
  */
 uint64_t ngtcp2_idtr_first_gap(ngtcp2_idtr *idtr);
 
+/*
+ * ngtcp2_idtr_sync_gap pushes the IDs which are recorded in the
+ * window to idtr->gap so that idtr->gap alone describes all used
+ * IDs.  |idtr| keeps working after this call.
+ *
+ * It returns 0 if it succeeds, or one of the following negative error
+ * codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ */
+int ngtcp2_idtr_sync_gap(ngtcp2_idtr *idtr);
+
 #endif /* NGTCP2_IDTR_H */
@@ -57,8 +57,11 @@ void ngtcp2_ksl_init(ngtcp2_ksl *ksl, ngtcp2_ksl_compar compar, size_t keylen,
                      const ngtcp2_mem *mem) {
   size_t nodelen = ksl_nodelen(keylen);
 
+  mem = ngtcp2_mem_for_subsys(mem, NGTCP2_MEM_SUBSYS_KSL);
+
   ngtcp2_objalloc_init(&ksl->blkalloc,
-                       ((ksl_blklen(nodelen) + 0xfu) & ~(uintptr_t)0xfu) * 8,
+                       ((ksl_blklen(nodelen) + 0xfu) & ~(uintptr_t)0xfu) *
+                           NGTCP2_KSL_OBJALLOC_NMEMB,
                        mem);
 
   ksl->head = NULL;
@@ -94,7 +97,6 @@ static int ksl_head_init(ngtcp2_ksl *ksl) {
   return 0;
 }
 
-#ifdef NOMEMPOOL
 /*
  * ksl_free_blk frees |blk| recursively.
  */
@@ -109,15 +111,16 @@ static void ksl_free_blk(ngtcp2_ksl *ksl, ngtcp2_ksl_blk *blk) {
 
   ksl_blk_objalloc_del(ksl, blk);
 }
-#endif /* NOMEMPOOL */
 
 void ngtcp2_ksl_free(ngtcp2_ksl *ksl) {
-  if (!ksl || !ksl->head) {
+  if (!ksl) {
     return;
   }
 
 #ifdef NOMEMPOOL
-  ksl_free_blk(ksl, ksl->head);
+  if (ksl->head) {
+    ksl_free_blk(ksl, ksl->head);
+  }
 #endif /* NOMEMPOOL */
 
   ngtcp2_objalloc_free(&ksl->blkalloc);
@@ -262,11 +265,64 @@ static void ksl_insert_node(ngtcp2_ksl *ksl, ngtcp2_ksl_blk *blk, size_t i,
   ++blk->n;
 }
 
+/*
+ * ksl_nth_key returns the pointer to the key of the |n|th node under
+ * |blk| as a pointer to |TYPE|.
+ */
+#define ksl_nth_key(KSL, BLK, N, TYPE)                                         \
+  ((const TYPE *)(const void *)ngtcp2_ksl_nth_node((KSL), (BLK), (N))->key)
+
+/*
+ * ksl_bsearch_def defines the function |NAME| which returns the
+ * index of the first node under |blk| whose key does not satisfy
+ * LESS(node key, key).  The key is read as |TYPE| from the start of
+ * key buffer.  It is a branchless binary search which does not call
+ * ngtcp2_ksl_compar.
+ */
+#define ksl_bsearch_def(NAME, TYPE, LESS)                                      \
+  static size_t NAME(ngtcp2_ksl *ksl, ngtcp2_ksl_blk *blk,                     \
+                     const ngtcp2_ksl_key *key) {                              \
+    TYPE k = *(const TYPE *)key;                                               \
+    size_t base = 0, n = blk->n, half;                                         \
+                                                                               \
+    if (n == 0) {                                                              \
+      return 0;                                                                \
+    }                                                                          \
+                                                                               \
+    for (; n > 1; n -= half) {                                                 \
+      half = n / 2;                                                            \
+      base = LESS(*ksl_nth_key(ksl, blk, base + half, TYPE), k) ? base + half  \
+                                                                : base;        \
+    }                                                                          \
+                                                                               \
+    return base + (size_t)LESS(*ksl_nth_key(ksl, blk, base, TYPE), k);         \
+  }
+
+#define ksl_less(A, B) ((A) < (B))
+#define ksl_greater(A, B) ((A) > (B))
+
+ksl_bsearch_def(ksl_int64_less_bsearch, int64_t, ksl_less)
+ksl_bsearch_def(ksl_int64_greater_bsearch, int64_t, ksl_greater)
+/* ngtcp2_range starts with begin field. */
+ksl_bsearch_def(ksl_range_bsearch, uint64_t, ksl_less)
+
 static size_t ksl_bsearch(ngtcp2_ksl *ksl, ngtcp2_ksl_blk *blk,
                           const ngtcp2_ksl_key *key, ngtcp2_ksl_compar compar) {
   size_t i;
   ngtcp2_ksl_node *node;
 
+  if (compar == ngtcp2_ksl_int64_greater) {
+    return ksl_int64_greater_bsearch(ksl, blk, key);
+  }
+
+  if (compar == ngtcp2_ksl_int64_less) {
+    return ksl_int64_less_bsearch(ksl, blk, key);
+  }
+
+  if (compar == ngtcp2_ksl_range_compar) {
+    return ksl_range_bsearch(ksl, blk, key);
+  }
+
   for (i = 0, node = (ngtcp2_ksl_node *)(void *)blk->nodes;
        i < blk->n && compar((ngtcp2_ksl_key *)node->key, key);
        ++i, node = (ngtcp2_ksl_node *)(void *)((uint8_t *)node + ksl->nodelen))
@@ -734,7 +790,9 @@ static void ksl_print(ngtcp2_ksl *ksl, ngtcp2_ksl_blk *blk, size_t level) {
   }
 }
 
+#ifdef NOINLINEHELPERS
 size_t ngtcp2_ksl_len(ngtcp2_ksl *ksl) { return ksl->n; }
+#endif /* NOINLINEHELPERS */
 
 void ngtcp2_ksl_clear(ngtcp2_ksl *ksl) {
   if (!ksl->head) {
@@ -751,6 +809,17 @@ void ngtcp2_ksl_clear(ngtcp2_ksl *ksl) {
   ngtcp2_objalloc_clear(&ksl->blkalloc);
 }
 
+void ngtcp2_ksl_reset(ngtcp2_ksl *ksl) {
+  if (!ksl->head) {
+    return;
+  }
+
+  ksl_free_blk(ksl, ksl->head);
+
+  ksl->front = ksl->back = ksl->head = NULL;
+  ksl->n = 0;
+}
+
 void ngtcp2_ksl_print(ngtcp2_ksl *ksl) {
   if (!ksl->head) {
     return;
@@ -801,9 +870,21 @@ void ngtcp2_ksl_it_prev(ngtcp2_ksl_it *it) {
   }
 }
 
+#ifdef NOINLINEHELPERS
 int ngtcp2_ksl_it_begin(const ngtcp2_ksl_it *it) {
   return it->i == 0 && it->blk->prev == NULL;
 }
+#endif /* NOINLINEHELPERS */
+
+int ngtcp2_ksl_int64_less(const ngtcp2_ksl_key *lhs,
+                          const ngtcp2_ksl_key *rhs) {
+  return *(const int64_t *)lhs < *(const int64_t *)rhs;
+}
+
+int ngtcp2_ksl_int64_greater(const ngtcp2_ksl_key *lhs,
+                             const ngtcp2_ksl_key *rhs) {
+  return *(const int64_t *)lhs > *(const int64_t *)rhs;
+}
 
 int ngtcp2_ksl_range_compar(const ngtcp2_ksl_key *lhs,
                             const ngtcp2_ksl_key *rhs) {
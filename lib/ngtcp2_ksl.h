@@ -46,6 +46,13 @@
 /* NGTCP2_KSL_MIN_NBLK is the minimum number of nodes which a single
    block other than root must contains. */
 #define NGTCP2_KSL_MIN_NBLK (NGTCP2_KSL_DEGR - 1)
+/* NGTCP2_KSL_OBJALLOC_NMEMB is the number of ngtcp2_ksl_blk which a
+   block of ngtcp2_ksl.blkalloc holds. */
+#ifndef LOWMEMORY
+#  define NGTCP2_KSL_OBJALLOC_NMEMB 8
+#else /* LOWMEMORY */
+#  define NGTCP2_KSL_OBJALLOC_NMEMB 1
+#endif /* LOWMEMORY */
 
 /*
  * ngtcp2_ksl_key represents key in ngtcp2_ksl.
@@ -247,16 +254,27 @@ ngtcp2_ksl_it ngtcp2_ksl_begin(const ngtcp2_ksl *ksl);
  */
 ngtcp2_ksl_it ngtcp2_ksl_end(const ngtcp2_ksl *ksl);
 
+#ifndef NOINLINEHELPERS
 /*
  * ngtcp2_ksl_len returns the number of elements stored in |ksl|.
  */
+static inline size_t ngtcp2_ksl_len(ngtcp2_ksl *ksl) { return ksl->n; }
+#else /* NOINLINEHELPERS */
 size_t ngtcp2_ksl_len(ngtcp2_ksl *ksl);
+#endif /* NOINLINEHELPERS */
 
 /*
  * ngtcp2_ksl_clear removes all elements stored in |ksl|.
  */
 void ngtcp2_ksl_clear(ngtcp2_ksl *ksl);
 
+/*
+ * ngtcp2_ksl_reset removes all elements stored in |ksl| like
+ * ngtcp2_ksl_clear, but it keeps the memory of the blocks for the
+ * future insertions.
+ */
+void ngtcp2_ksl_reset(ngtcp2_ksl *ksl);
+
 /*
  * ngtcp2_ksl_nth_node returns the |n|th node under |blk|.
  */
@@ -308,12 +326,18 @@ void ngtcp2_ksl_it_prev(ngtcp2_ksl_it *it);
 #define ngtcp2_ksl_it_end(IT)                                                  \
   ((IT)->blk->n == (IT)->i && (IT)->blk->next == NULL)
 
+#ifndef NOINLINEHELPERS
 /*
  * ngtcp2_ksl_it_begin returns nonzero if |it| points to the first
  * node.  |it| might satisfy both ngtcp2_ksl_it_begin(&it) and
  * ngtcp2_ksl_it_end(&it) if the skip list has no node.
  */
+static inline int ngtcp2_ksl_it_begin(const ngtcp2_ksl_it *it) {
+  return it->i == 0 && it->blk->prev == NULL;
+}
+#else /* NOINLINEHELPERS */
 int ngtcp2_ksl_it_begin(const ngtcp2_ksl_it *it);
+#endif /* NOINLINEHELPERS */
 
 /*
  * ngtcp2_ksl_key returns the key of the node which |it| points to.
@@ -323,11 +347,31 @@ int ngtcp2_ksl_it_begin(const ngtcp2_ksl_it *it);
 #define ngtcp2_ksl_it_key(IT)                                                  \
   ((ngtcp2_ksl_key *)ngtcp2_ksl_nth_node((IT)->ksl, (IT)->blk, (IT)->i)->key)
 
+/*
+ * ngtcp2_ksl_int64_less is an implementation of ngtcp2_ksl_compar.
+ * lhs and rhs must point to int64_t, and the function returns nonzero
+ * if *lhs < *rhs.  ngtcp2_ksl recognizes this function and searches
+ * blocks without calling it for each node.
+ */
+int ngtcp2_ksl_int64_less(const ngtcp2_ksl_key *lhs,
+                          const ngtcp2_ksl_key *rhs);
+
+/*
+ * ngtcp2_ksl_int64_greater is an implementation of ngtcp2_ksl_compar.
+ * lhs and rhs must point to int64_t, and the function returns nonzero
+ * if *lhs > *rhs.  Like ngtcp2_ksl_int64_less, ngtcp2_ksl searches
+ * blocks without calling it for each node.
+ */
+int ngtcp2_ksl_int64_greater(const ngtcp2_ksl_key *lhs,
+                             const ngtcp2_ksl_key *rhs);
+
 /*
  * ngtcp2_ksl_range_compar is an implementation of ngtcp2_ksl_compar.
  * lhs->ptr and rhs->ptr must point to ngtcp2_range object and the
  * function returns nonzero if (const ngtcp2_range *)(lhs->ptr)->begin
- * < (const ngtcp2_range *)(rhs->ptr)->begin.
+ * < (const ngtcp2_range *)(rhs->ptr)->begin.  Like
+ * ngtcp2_ksl_int64_less, ngtcp2_ksl searches blocks without calling
+ * it for each node.
  */
 int ngtcp2_ksl_range_compar(const ngtcp2_ksl_key *lhs,
                             const ngtcp2_ksl_key *rhs);
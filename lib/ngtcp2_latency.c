@@ -0,0 +1,151 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_latency.h"
+
+#include <assert.h>
+#include <limits.h>
+
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#endif
+
+#define NGTCP2_LATENCY_HIST_SUB_NBUCKET (1u << NGTCP2_LATENCY_HIST_SUB_BITS)
+
+/*
+ * latency_log2 returns the position of the most significant bit set
+ * in |n|.  |n| must not be 0.
+ */
+static size_t latency_log2(uint64_t n) {
+  int d;
+
+  assert(n);
+
+#if defined(_MSC_VER)
+#  if defined(_M_X64)
+  d = (int)__lzcnt64(n);
+#  elif defined(_M_ARM64)
+  {
+    unsigned long index;
+    d = sizeof(uint64_t) * CHAR_BIT;
+    if (_BitScanReverse64(&index, n)) {
+      d = d - 1 - index;
+    }
+  }
+#  else
+  if ((n >> 32) != 0) {
+    d = __lzcnt((unsigned int)(n >> 32));
+  } else {
+    d = 32 + __lzcnt((unsigned int)n);
+  }
+#  endif
+#else
+  d = __builtin_clzll(n);
+#endif
+
+  return (size_t)(63 - d);
+}
+
+size_t ngtcp2_latency_hist_bucket(ngtcp2_duration d) {
+  size_t e, idx;
+
+  if (d < NGTCP2_LATENCY_HIST_SUB_NBUCKET) {
+    return (size_t)d;
+  }
+
+  e = latency_log2(d);
+  idx = NGTCP2_LATENCY_HIST_SUB_NBUCKET *
+            (e - NGTCP2_LATENCY_HIST_SUB_BITS + 1) +
+        (size_t)((d >> (e - NGTCP2_LATENCY_HIST_SUB_BITS)) &
+                 (NGTCP2_LATENCY_HIST_SUB_NBUCKET - 1));
+
+  if (idx >= NGTCP2_LATENCY_HIST_NBUCKET) {
+    return NGTCP2_LATENCY_HIST_NBUCKET - 1;
+  }
+
+  return idx;
+}
+
+void ngtcp2_latency_hist_add(ngtcp2_latency_hist *hist, ngtcp2_duration d) {
+  ++hist->count;
+  hist->sum += d;
+  if (hist->max < d) {
+    hist->max = d;
+  }
+
+  ++hist->buckets[ngtcp2_latency_hist_bucket(d)];
+}
+
+ngtcp2_duration ngtcp2_latency_hist_bucket_lower(size_t idx) {
+  size_t e, sub;
+
+  assert(idx < NGTCP2_LATENCY_HIST_NBUCKET);
+
+  if (idx < NGTCP2_LATENCY_HIST_SUB_NBUCKET) {
+    return idx;
+  }
+
+  e = idx / NGTCP2_LATENCY_HIST_SUB_NBUCKET + NGTCP2_LATENCY_HIST_SUB_BITS - 1;
+  sub = idx % NGTCP2_LATENCY_HIST_SUB_NBUCKET;
+
+  return (ngtcp2_duration)(NGTCP2_LATENCY_HIST_SUB_NBUCKET + sub)
+         << (e - NGTCP2_LATENCY_HIST_SUB_BITS);
+}
+
+ngtcp2_duration ngtcp2_latency_hist_percentile(const ngtcp2_latency_hist *hist,
+                                               double percentile) {
+  uint64_t rank, n = 0;
+  ngtcp2_duration d;
+  size_t i;
+
+  assert(percentile >= 0 && percentile <= 100);
+
+  if (hist->count == 0) {
+    return 0;
+  }
+
+  /* rank is the 1-based rank of the sample at the percentile. */
+  rank = (uint64_t)((double)hist->count * percentile / 100);
+  if (rank == 0) {
+    rank = 1;
+  }
+
+  for (i = 0; i < NGTCP2_LATENCY_HIST_NBUCKET; ++i) {
+    n += hist->buckets[i];
+    if (n >= rank) {
+      break;
+    }
+  }
+
+  assert(i < NGTCP2_LATENCY_HIST_NBUCKET);
+
+  if (i == NGTCP2_LATENCY_HIST_NBUCKET - 1) {
+    return hist->max;
+  }
+
+  /* The largest duration which falls into the bucket */
+  d = ngtcp2_latency_hist_bucket_lower(i + 1) - 1;
+
+  return d < hist->max ? d : hist->max;
+}
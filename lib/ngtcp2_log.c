@@ -36,15 +36,17 @@
 #include "ngtcp2_macro.h"
 #include "ngtcp2_conv.h"
 
+#ifndef NOLOG
 void ngtcp2_log_init(ngtcp2_log *log, const ngtcp2_cid *scid,
-                     ngtcp2_printf log_printf, ngtcp2_tstamp ts,
-                     void *user_data) {
+                     ngtcp2_printf log_printf, ngtcp2_log_record_cb log_record,
+                     ngtcp2_tstamp ts, void *user_data) {
   if (scid) {
     ngtcp2_encode_hex(log->scid, scid->data, scid->datalen);
   } else {
     log->scid[0] = '\0';
   }
   log->log_printf = log_printf;
+  log->log_record = log_record;
   log->ts = log->last_ts = ts;
   log->user_data = user_data;
 }
@@ -86,8 +88,63 @@ void ngtcp2_log_init(ngtcp2_log *log, const ngtcp2_cid *scid,
  *
  * <FRAMETYPE>:
  *   Frame type in hex string.
+ *
+ * # Structured log
+ *
+ * If log_record is set, each public function below hands a
+ * ngtcp2_log_record to it instead of formatting text.  The record
+ * points to the arguments of the function, and
+ * ngtcp2_log_record_print renders it later with the same text
+ * functions, so that the both modes produce the identical output.
  */
 
+/* ngtcp2_log_info_data is the payload of
+   NGTCP2_LOG_RECORD_TYPE_INFO. */
+typedef struct ngtcp2_log_info_data {
+  const char *fmt;
+  va_list *ap;
+} ngtcp2_log_info_data;
+
+/* ngtcp2_log_vn_data is the payload of
+   NGTCP2_LOG_RECORD_TYPE_VERSION_NEGOTIATION. */
+typedef struct ngtcp2_log_vn_data {
+  const uint32_t *sv;
+  size_t nsv;
+} ngtcp2_log_vn_data;
+
+/* ngtcp2_log_pkt_lost_data is the payload of
+   NGTCP2_LOG_RECORD_TYPE_PKT_LOST. */
+typedef struct ngtcp2_log_pkt_lost_data {
+  int64_t pkt_num;
+  uint8_t type;
+  uint8_t flags;
+  ngtcp2_tstamp sent_ts;
+} ngtcp2_log_pkt_lost_data;
+
+/* ngtcp2_log_remote_tp_data is the payload of
+   NGTCP2_LOG_RECORD_TYPE_REMOTE_TRANSPORT_PARAMS. */
+typedef struct ngtcp2_log_remote_tp_data {
+  uint8_t exttype;
+  const ngtcp2_transport_params *params;
+} ngtcp2_log_remote_tp_data;
+
+static void log_record(ngtcp2_log *log, ngtcp2_log_record_type type,
+                       ngtcp2_log_event ev, int tx, const ngtcp2_pkt_hd *hd,
+                       uint64_t frame_type, const void *data) {
+  ngtcp2_log_record rec;
+
+  rec.type = type;
+  rec.event = ev;
+  rec.elapsed = log->last_ts - log->ts;
+  rec.scid = (const char *)log->scid;
+  rec.tx = tx;
+  rec.hd = hd;
+  rec.frame_type = frame_type;
+  rec.data = data;
+
+  log->log_record(log->user_data, &rec);
+}
+
 #define NGTCP2_LOG_BUFLEN 4096
 
 /* TODO Split second and remaining fraction with comma */
@@ -230,7 +287,8 @@ static void log_fr_stream(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
 static void log_fr_ack(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
                        const ngtcp2_ack *fr, const char *dir) {
   int64_t largest_ack, min_ack;
-  size_t i;
+  ngtcp2_ack_range_it it;
+  ngtcp2_ack_blk blk;
 
   log->log_printf(log->user_data,
                   (NGTCP2_LOG_PKT " ACK(0x%02x) largest_ack=%" PRId64
@@ -238,7 +296,7 @@ static void log_fr_ack(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
                                   ") ack_block_count=%zu"),
                   NGTCP2_LOG_FRM_HD_FIELDS(dir), fr->type, fr->largest_ack,
                   fr->ack_delay_unscaled / NGTCP2_MILLISECONDS, fr->ack_delay,
-                  fr->num_blks);
+                  (size_t)fr->num_blks);
 
   largest_ack = fr->largest_ack;
   min_ack = fr->largest_ack - (int64_t)fr->first_ack_blklen;
@@ -249,15 +307,16 @@ static void log_fr_ack(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
                   NGTCP2_LOG_FRM_HD_FIELDS(dir), fr->type, largest_ack, min_ack,
                   fr->first_ack_blklen);
 
-  for (i = 0; i < fr->num_blks; ++i) {
-    const ngtcp2_ack_blk *blk = &fr->blks[i];
-    largest_ack = min_ack - (int64_t)blk->gap - 2;
-    min_ack = largest_ack - (int64_t)blk->blklen;
+  ngtcp2_ack_range_it_init(&it, fr);
+
+  while (ngtcp2_ack_range_it_next(&it, &blk)) {
+    largest_ack = min_ack - (int64_t)blk.gap - 2;
+    min_ack = largest_ack - (int64_t)blk.blklen;
     log->log_printf(log->user_data,
                     (NGTCP2_LOG_PKT " ACK(0x%02x) block=[%" PRId64 "..%" PRId64
                                     "] gap=%" PRIu64 " block_count=%" PRIu64),
                     NGTCP2_LOG_FRM_HD_FIELDS(dir), fr->type, largest_ack,
-                    min_ack, blk->gap, blk->blklen);
+                    min_ack, blk.gap, blk.blklen);
   }
 
   if (fr->type == NGTCP2_FRAME_ACK_ECN) {
@@ -463,6 +522,35 @@ static void log_fr_datagram(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
                   ngtcp2_vec_len(fr->data, fr->datacnt));
 }
 
+static void log_fr_ack_frequency(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
+                                 const ngtcp2_ack_frequency *fr,
+                                 const char *dir) {
+  log->log_printf(log->user_data,
+                  (NGTCP2_LOG_PKT " ACK_FREQUENCY(0x%02x) seq=%" PRIu64
+                                  " ack_eliciting_threshold=%" PRIu64
+                                  " request_max_ack_delay=%" PRIu64
+                                  " reordering_threshold=%" PRIu64),
+                  NGTCP2_LOG_FRM_HD_FIELDS(dir), fr->type, fr->seq,
+                  fr->ack_eliciting_threshold, fr->request_max_ack_delay,
+                  fr->reordering_threshold);
+}
+
+static void log_fr_immediate_ack(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
+                                 const ngtcp2_immediate_ack *fr,
+                                 const char *dir) {
+  log->log_printf(log->user_data, (NGTCP2_LOG_PKT " IMMEDIATE_ACK(0x%02x)"),
+                  NGTCP2_LOG_FRM_HD_FIELDS(dir), fr->type);
+}
+
+static void log_fr_repair(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
+                          const ngtcp2_repair *fr, const char *dir) {
+  log->log_printf(log->user_data,
+                  (NGTCP2_LOG_PKT " REPAIR(0x%02x) id=0x%" PRIx64
+                                  " offset=%" PRIu64 " symbolcnt=%zu len=%zu"),
+                  NGTCP2_LOG_FRM_HD_FIELDS(dir), fr->type, fr->stream_id,
+                  fr->offset, fr->symbolcnt, fr->data.len);
+}
+
 static void log_fr(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
                    const ngtcp2_frame *fr, const char *dir) {
   switch (fr->type) {
@@ -534,6 +622,15 @@ static void log_fr(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
   case NGTCP2_FRAME_DATAGRAM_LEN:
     log_fr_datagram(log, hd, &fr->datagram, dir);
     break;
+  case NGTCP2_FRAME_ACK_FREQUENCY:
+    log_fr_ack_frequency(log, hd, &fr->ack_frequency, dir);
+    break;
+  case NGTCP2_FRAME_IMMEDIATE_ACK:
+    log_fr_immediate_ack(log, hd, &fr->immediate_ack, dir);
+    break;
+  case NGTCP2_FRAME_REPAIR:
+    log_fr_repair(log, hd, &fr->repair, dir);
+    break;
   default:
     assert(0);
   }
@@ -541,6 +638,12 @@ static void log_fr(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
 
 void ngtcp2_log_rx_fr(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
                       const ngtcp2_frame *fr) {
+  if (log->log_record) {
+    log_record(log, NGTCP2_LOG_RECORD_TYPE_FRAME, NGTCP2_LOG_EVENT_FRM, 0, hd,
+               fr->type, fr);
+    return;
+  }
+
   if (!log->log_printf) {
     return;
   }
@@ -550,6 +653,12 @@ void ngtcp2_log_rx_fr(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
 
 void ngtcp2_log_tx_fr(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
                       const ngtcp2_frame *fr) {
+  if (log->log_record) {
+    log_record(log, NGTCP2_LOG_RECORD_TYPE_FRAME, NGTCP2_LOG_EVENT_FRM, 1, hd,
+               fr->type, fr);
+    return;
+  }
+
   if (!log->log_printf) {
     return;
   }
@@ -557,29 +666,42 @@ void ngtcp2_log_tx_fr(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
   log_fr(log, hd, fr, "tx");
 }
 
-void ngtcp2_log_rx_vn(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
+static void log_rx_vn(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
                       const uint32_t *sv, size_t nsv) {
   size_t i;
 
-  if (!log->log_printf) {
-    return;
-  }
-
   for (i = 0; i < nsv; ++i) {
     log->log_printf(log->user_data, (NGTCP2_LOG_PKT " v=0x%08x"),
                     NGTCP2_LOG_PKT_HD_FIELDS("rx"), sv[i]);
   }
 }
 
-void ngtcp2_log_rx_sr(ngtcp2_log *log, const ngtcp2_pkt_stateless_reset *sr) {
-  uint8_t buf[sizeof(sr->stateless_reset_token) * 2 + 1];
-  ngtcp2_pkt_hd shd;
-  ngtcp2_pkt_hd *hd = &shd;
+void ngtcp2_log_rx_vn(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
+                      const uint32_t *sv, size_t nsv) {
+  ngtcp2_log_vn_data data;
+
+  if (log->log_record) {
+    data.sv = sv;
+    data.nsv = nsv;
+
+    log_record(log, NGTCP2_LOG_RECORD_TYPE_VERSION_NEGOTIATION,
+               NGTCP2_LOG_EVENT_PKT, 0, hd, 0, &data);
+    return;
+  }
 
   if (!log->log_printf) {
     return;
   }
 
+  log_rx_vn(log, hd, sv, nsv);
+}
+
+static void log_rx_sr(ngtcp2_log *log,
+                      const ngtcp2_pkt_stateless_reset *sr) {
+  uint8_t buf[sizeof(sr->stateless_reset_token) * 2 + 1];
+  ngtcp2_pkt_hd shd;
+  ngtcp2_pkt_hd *hd = &shd;
+
   memset(&shd, 0, sizeof(shd));
 
   shd.type = NGTCP2_PKT_STATELESS_RESET;
@@ -592,17 +714,27 @@ void ngtcp2_log_rx_sr(ngtcp2_log *log, const ngtcp2_pkt_stateless_reset *sr) {
       sr->randlen);
 }
 
-void ngtcp2_log_remote_tp(ngtcp2_log *log, uint8_t exttype,
+void ngtcp2_log_rx_sr(ngtcp2_log *log, const ngtcp2_pkt_stateless_reset *sr) {
+  if (log->log_record) {
+    log_record(log, NGTCP2_LOG_RECORD_TYPE_STATELESS_RESET,
+               NGTCP2_LOG_EVENT_PKT, 0, NULL, 0, sr);
+    return;
+  }
+
+  if (!log->log_printf) {
+    return;
+  }
+
+  log_rx_sr(log, sr);
+}
+
+static void log_remote_tp(ngtcp2_log *log, uint8_t exttype,
                           const ngtcp2_transport_params *params) {
   uint8_t token[NGTCP2_STATELESS_RESET_TOKENLEN * 2 + 1];
   uint8_t addr[16 * 2 + 7 + 1];
   uint8_t cid[NGTCP2_MAX_CIDLEN * 2 + 1];
   size_t i;
 
-  if (!log->log_printf) {
-    return;
-  }
-
   if (exttype == NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS) {
     if (params->stateless_reset_token_present) {
       log->log_printf(log->user_data,
@@ -711,6 +843,11 @@ void ngtcp2_log_remote_tp(ngtcp2_log *log, uint8_t exttype,
                   NGTCP2_LOG_TP_HD_FIELDS, params->max_datagram_frame_size);
   log->log_printf(log->user_data, (NGTCP2_LOG_TP " grease_quic_bit=%d"),
                   NGTCP2_LOG_TP_HD_FIELDS, params->grease_quic_bit);
+  log->log_printf(log->user_data, (NGTCP2_LOG_TP " min_ack_delay=%" PRIu64),
+                  NGTCP2_LOG_TP_HD_FIELDS,
+                  params->min_ack_delay / NGTCP2_MICROSECONDS);
+  log->log_printf(log->user_data, (NGTCP2_LOG_TP " fec_window=%" PRIu64),
+                  NGTCP2_LOG_TP_HD_FIELDS, params->fec_window);
 
   if (params->version_info_present) {
     log->log_printf(
@@ -731,15 +868,65 @@ void ngtcp2_log_remote_tp(ngtcp2_log *log, uint8_t exttype,
   }
 }
 
+void ngtcp2_log_remote_tp(ngtcp2_log *log, uint8_t exttype,
+                          const ngtcp2_transport_params *params) {
+  ngtcp2_log_remote_tp_data data;
+
+  if (log->log_record) {
+    data.exttype = exttype;
+    data.params = params;
+
+    log_record(log, NGTCP2_LOG_RECORD_TYPE_REMOTE_TRANSPORT_PARAMS,
+               NGTCP2_LOG_EVENT_CRY, 0, NULL, 0, &data);
+    return;
+  }
+
+  if (!log->log_printf) {
+    return;
+  }
+
+  log_remote_tp(log, exttype, params);
+}
+
+static void log_info(ngtcp2_log *log, ngtcp2_log_event ev, const char *fmt,
+                     va_list ap);
+
+static void log_infof(ngtcp2_log *log, ngtcp2_log_event ev, const char *fmt,
+                      ...) {
+  va_list ap;
+
+  va_start(ap, fmt);
+  log_info(log, ev, fmt, ap);
+  va_end(ap);
+}
+
+static void log_pkt_lost(ngtcp2_log *log, int64_t pkt_num, uint8_t type,
+                         uint8_t flags, ngtcp2_tstamp sent_ts) {
+  log_infof(log, NGTCP2_LOG_EVENT_RCV,
+            "pkn=%" PRId64 " lost type=%s sent_ts=%" PRIu64, pkt_num,
+            strpkttype_type_flags(type, flags), sent_ts);
+}
+
 void ngtcp2_log_pkt_lost(ngtcp2_log *log, int64_t pkt_num, uint8_t type,
                          uint8_t flags, ngtcp2_tstamp sent_ts) {
+  ngtcp2_log_pkt_lost_data data;
+
+  if (log->log_record) {
+    data.pkt_num = pkt_num;
+    data.type = type;
+    data.flags = flags;
+    data.sent_ts = sent_ts;
+
+    log_record(log, NGTCP2_LOG_RECORD_TYPE_PKT_LOST, NGTCP2_LOG_EVENT_RCV, 0,
+               NULL, 0, &data);
+    return;
+  }
+
   if (!log->log_printf) {
     return;
   }
 
-  ngtcp2_log_info(log, NGTCP2_LOG_EVENT_RCV,
-                  "pkn=%" PRId64 " lost type=%s sent_ts=%" PRIu64, pkt_num,
-                  strpkttype_type_flags(type, flags), sent_ts);
+  log_pkt_lost(log, pkt_num, type, flags, sent_ts);
 }
 
 static void log_pkt_hd(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
@@ -747,18 +934,14 @@ static void log_pkt_hd(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
   uint8_t dcid[sizeof(hd->dcid.data) * 2 + 1];
   uint8_t scid[sizeof(hd->scid.data) * 2 + 1];
 
-  if (!log->log_printf) {
-    return;
-  }
-
   if (hd->type == NGTCP2_PKT_1RTT) {
-    ngtcp2_log_info(
+    log_infof(
         log, NGTCP2_LOG_EVENT_PKT, "%s pkn=%" PRId64 " dcid=0x%s type=%s k=%d",
         dir, hd->pkt_num,
         (const char *)ngtcp2_encode_hex(dcid, hd->dcid.data, hd->dcid.datalen),
         strpkttype(hd), (hd->flags & NGTCP2_PKT_FLAG_KEY_PHASE) != 0);
   } else {
-    ngtcp2_log_info(
+    log_infof(
         log, NGTCP2_LOG_EVENT_PKT,
         "%s pkn=%" PRId64 " dcid=0x%s scid=0x%s version=0x%08x type=%s len=%zu",
         dir, hd->pkt_num,
@@ -769,26 +952,39 @@ static void log_pkt_hd(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
 }
 
 void ngtcp2_log_rx_pkt_hd(ngtcp2_log *log, const ngtcp2_pkt_hd *hd) {
+  if (log->log_record) {
+    log_record(log, NGTCP2_LOG_RECORD_TYPE_PKT, NGTCP2_LOG_EVENT_PKT, 0, hd, 0,
+               NULL);
+    return;
+  }
+
+  if (!log->log_printf) {
+    return;
+  }
+
   log_pkt_hd(log, hd, "rx");
 }
 
 void ngtcp2_log_tx_pkt_hd(ngtcp2_log *log, const ngtcp2_pkt_hd *hd) {
+  if (log->log_record) {
+    log_record(log, NGTCP2_LOG_RECORD_TYPE_PKT, NGTCP2_LOG_EVENT_PKT, 1, hd, 0,
+               NULL);
+    return;
+  }
+
+  if (!log->log_printf) {
+    return;
+  }
+
   log_pkt_hd(log, hd, "tx");
 }
 
-void ngtcp2_log_info(ngtcp2_log *log, ngtcp2_log_event ev, const char *fmt,
-                     ...) {
-  va_list ap;
+static void log_info(ngtcp2_log *log, ngtcp2_log_event ev, const char *fmt,
+                     va_list ap) {
   int n;
   char buf[NGTCP2_LOG_BUFLEN];
 
-  if (!log->log_printf) {
-    return;
-  }
-
-  va_start(ap, fmt);
   n = vsnprintf(buf, sizeof(buf), fmt, ap);
-  va_end(ap);
 
   if (n < 0 || (size_t)n >= sizeof(buf)) {
     return;
@@ -799,8 +995,110 @@ void ngtcp2_log_info(ngtcp2_log *log, ngtcp2_log_event ev, const char *fmt,
                   strevent(ev), buf);
 }
 
+void ngtcp2_log_info(ngtcp2_log *log, ngtcp2_log_event ev, const char *fmt,
+                     ...) {
+  va_list ap;
+  ngtcp2_log_info_data data;
+
+  if (!log->log_record && !log->log_printf) {
+    return;
+  }
+
+  va_start(ap, fmt);
+
+  if (log->log_record) {
+    data.fmt = fmt;
+    data.ap = &ap;
+
+    log_record(log, NGTCP2_LOG_RECORD_TYPE_INFO, ev, 0, NULL, 0, &data);
+  } else {
+    log_info(log, ev, fmt, ap);
+  }
+
+  va_end(ap);
+}
+
+static void log_tx_cancel(ngtcp2_log *log, const ngtcp2_pkt_hd *hd) {
+  log_infof(log, NGTCP2_LOG_EVENT_PKT, "cancel tx pkn=%" PRId64 " type=%s",
+            hd->pkt_num, strpkttype(hd));
+}
+
 void ngtcp2_log_tx_cancel(ngtcp2_log *log, const ngtcp2_pkt_hd *hd) {
-  ngtcp2_log_info(log, NGTCP2_LOG_EVENT_PKT,
-                  "cancel tx pkn=%" PRId64 " type=%s", hd->pkt_num,
-                  strpkttype(hd));
+  if (log->log_record) {
+    log_record(log, NGTCP2_LOG_RECORD_TYPE_TX_CANCEL, NGTCP2_LOG_EVENT_PKT, 1,
+               hd, 0, NULL);
+    return;
+  }
+
+  if (!log->log_printf) {
+    return;
+  }
+
+  log_tx_cancel(log, hd);
+}
+
+void ngtcp2_log_record_print(const ngtcp2_log_record *rec,
+                             ngtcp2_printf log_printf, void *user_data) {
+  ngtcp2_log log;
+  size_t scidlen = strlen(rec->scid);
+  const ngtcp2_log_info_data *info;
+  const ngtcp2_log_vn_data *vn;
+  const ngtcp2_log_pkt_lost_data *lost;
+  const ngtcp2_log_remote_tp_data *tp;
+  va_list ap;
+
+  assert(scidlen < sizeof(log.scid));
+
+  memcpy(log.scid, rec->scid, scidlen + 1);
+  log.log_printf = log_printf;
+  log.log_record = NULL;
+  log.ts = 0;
+  log.last_ts = rec->elapsed;
+  log.user_data = user_data;
+
+  switch (rec->type) {
+  case NGTCP2_LOG_RECORD_TYPE_INFO:
+    info = rec->data;
+
+    /* The callback might render the same record more than once. */
+    va_copy(ap, *info->ap);
+    log_info(&log, rec->event, info->fmt, ap);
+    va_end(ap);
+
+    return;
+  case NGTCP2_LOG_RECORD_TYPE_PKT:
+    log_pkt_hd(&log, rec->hd, rec->tx ? "tx" : "rx");
+    return;
+  case NGTCP2_LOG_RECORD_TYPE_FRAME:
+    log_fr(&log, rec->hd, rec->data, rec->tx ? "tx" : "rx");
+    return;
+  case NGTCP2_LOG_RECORD_TYPE_PKT_LOST:
+    lost = rec->data;
+    log_pkt_lost(&log, lost->pkt_num, lost->type, lost->flags, lost->sent_ts);
+    return;
+  case NGTCP2_LOG_RECORD_TYPE_TX_CANCEL:
+    log_tx_cancel(&log, rec->hd);
+    return;
+  case NGTCP2_LOG_RECORD_TYPE_VERSION_NEGOTIATION:
+    vn = rec->data;
+    log_rx_vn(&log, rec->hd, vn->sv, vn->nsv);
+    return;
+  case NGTCP2_LOG_RECORD_TYPE_STATELESS_RESET:
+    log_rx_sr(&log, rec->data);
+    return;
+  case NGTCP2_LOG_RECORD_TYPE_REMOTE_TRANSPORT_PARAMS:
+    tp = rec->data;
+    log_remote_tp(&log, tp->exttype, tp->params);
+    return;
+  default:
+    assert(0);
+  }
+}
+#else /* NOLOG */
+void ngtcp2_log_record_print(const ngtcp2_log_record *rec,
+                             ngtcp2_printf log_printf, void *user_data) {
+  (void)rec;
+  (void)log_printf;
+  (void)user_data;
 }
+#endif /* NOLOG */
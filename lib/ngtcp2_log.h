@@ -37,6 +37,9 @@ typedef struct ngtcp2_log {
   /* log_printf is a sink to write log.  NULL means no logging
      output. */
   ngtcp2_printf log_printf;
+  /* log_record is a sink to write structured log.  If it is not
+     NULL, it is used instead of log_printf. */
+  ngtcp2_log_record_cb log_record;
   /* ts is the time point used to write time delta in the log. */
   ngtcp2_tstamp ts;
   /* last_ts is the most recent time point that this object is
@@ -49,46 +52,10 @@ typedef struct ngtcp2_log {
   uint8_t scid[NGTCP2_MAX_CIDLEN * 2 + 1];
 } ngtcp2_log;
 
-/**
- * @enum
- *
- * :type:`ngtcp2_log_event` defines an event of ngtcp2 library
- * internal logger.
- */
-typedef enum ngtcp2_log_event {
-  /**
-   * :enum:`NGTCP2_LOG_EVENT_NONE` represents no event.
-   */
-  NGTCP2_LOG_EVENT_NONE,
-  /**
-   * :enum:`NGTCP2_LOG_EVENT_CON` is a connection (catch-all) event
-   */
-  NGTCP2_LOG_EVENT_CON,
-  /**
-   * :enum:`NGTCP2_LOG_EVENT_PKT` is a packet event.
-   */
-  NGTCP2_LOG_EVENT_PKT,
-  /**
-   * :enum:`NGTCP2_LOG_EVENT_FRM` is a QUIC frame event.
-   */
-  NGTCP2_LOG_EVENT_FRM,
-  /**
-   * :enum:`NGTCP2_LOG_EVENT_RCV` is a congestion and recovery event.
-   */
-  NGTCP2_LOG_EVENT_RCV,
-  /**
-   * :enum:`NGTCP2_LOG_EVENT_CRY` is a crypto event.
-   */
-  NGTCP2_LOG_EVENT_CRY,
-  /**
-   * :enum:`NGTCP2_LOG_EVENT_PTV` is a path validation event.
-   */
-  NGTCP2_LOG_EVENT_PTV,
-} ngtcp2_log_event;
-
+#ifndef NOLOG
 void ngtcp2_log_init(ngtcp2_log *log, const ngtcp2_cid *scid,
-                     ngtcp2_printf log_printf, ngtcp2_tstamp ts,
-                     void *user_data);
+                     ngtcp2_printf log_printf, ngtcp2_log_record_cb log_record,
+                     ngtcp2_tstamp ts, void *user_data);
 
 void ngtcp2_log_rx_fr(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
                       const ngtcp2_frame *fr);
@@ -120,4 +87,97 @@ void ngtcp2_log_tx_cancel(ngtcp2_log *log, const ngtcp2_pkt_hd *hd);
 void ngtcp2_log_info(ngtcp2_log *log, ngtcp2_log_event ev, const char *fmt,
                      ...);
 
+#else /* NOLOG */
+
+/* If NOLOG is defined, the log functions are compiled to nothing so
+   that the callers do not pay for the calls and the sink checks. */
+
+static inline void ngtcp2_log_init(ngtcp2_log *log, const ngtcp2_cid *scid,
+                                   ngtcp2_printf log_printf,
+                                   ngtcp2_log_record_cb log_record,
+                                   ngtcp2_tstamp ts, void *user_data) {
+  (void)scid;
+  (void)log_printf;
+  (void)log_record;
+
+  log->log_printf = NULL;
+  log->log_record = NULL;
+  log->ts = log->last_ts = ts;
+  log->user_data = user_data;
+  log->scid[0] = '\0';
+}
+
+static inline void ngtcp2_log_rx_fr(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
+                                    const ngtcp2_frame *fr) {
+  (void)log;
+  (void)hd;
+  (void)fr;
+}
+
+static inline void ngtcp2_log_tx_fr(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
+                                    const ngtcp2_frame *fr) {
+  (void)log;
+  (void)hd;
+  (void)fr;
+}
+
+static inline void ngtcp2_log_rx_vn(ngtcp2_log *log, const ngtcp2_pkt_hd *hd,
+                                    const uint32_t *sv, size_t nsv) {
+  (void)log;
+  (void)hd;
+  (void)sv;
+  (void)nsv;
+}
+
+static inline void ngtcp2_log_rx_sr(ngtcp2_log *log,
+                                    const ngtcp2_pkt_stateless_reset *sr) {
+  (void)log;
+  (void)sr;
+}
+
+static inline void
+ngtcp2_log_remote_tp(ngtcp2_log *log, uint8_t exttype,
+                     const ngtcp2_transport_params *params) {
+  (void)log;
+  (void)exttype;
+  (void)params;
+}
+
+static inline void ngtcp2_log_pkt_lost(ngtcp2_log *log, int64_t pkt_num,
+                                       uint8_t type, uint8_t flags,
+                                       ngtcp2_tstamp sent_ts) {
+  (void)log;
+  (void)pkt_num;
+  (void)type;
+  (void)flags;
+  (void)sent_ts;
+}
+
+static inline void ngtcp2_log_rx_pkt_hd(ngtcp2_log *log,
+                                        const ngtcp2_pkt_hd *hd) {
+  (void)log;
+  (void)hd;
+}
+
+static inline void ngtcp2_log_tx_pkt_hd(ngtcp2_log *log,
+                                        const ngtcp2_pkt_hd *hd) {
+  (void)log;
+  (void)hd;
+}
+
+static inline void ngtcp2_log_tx_cancel(ngtcp2_log *log,
+                                        const ngtcp2_pkt_hd *hd) {
+  (void)log;
+  (void)hd;
+}
+
+static inline void ngtcp2_log_info(ngtcp2_log *log, ngtcp2_log_event ev,
+                                   const char *fmt, ...) {
+  (void)log;
+  (void)ev;
+  (void)fmt;
+}
+
+#endif /* NOLOG */
+
 #endif /* NGTCP2_LOG_H */
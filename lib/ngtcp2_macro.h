@@ -39,6 +39,14 @@
 #define ngtcp2_struct_of(ptr, type, member)                                    \
   ((type *)(void *)((char *)(ptr)-offsetof(type, member)))
 
+/* ngtcp2_prefetch hints the CPU to load the cache line which contains
+   |P| for read. */
+#if defined(__GNUC__) || defined(__clang__)
+#  define ngtcp2_prefetch(P) __builtin_prefetch((P))
+#else /* !(defined(__GNUC__) || defined(__clang__)) */
+#  define ngtcp2_prefetch(P) ((void)(P))
+#endif /* !(defined(__GNUC__) || defined(__clang__)) */
+
 /* ngtcp2_list_insert inserts |T| before |*PD|.  The contract is that
    this is singly linked list, and the next element is pointed by next
    field of the previous element.  |PD| must be a pointer to the
@@ -213,6 +213,23 @@ static int map_resize(ngtcp2_map *map, uint32_t new_tablelen,
   return 0;
 }
 
+/*
+ * map_shrink halves the table of |map| if its load factor drops to
+ * 0.125 or below, so that a burst of short-lived entries does not
+ * leave a large table behind.  The load factor after shrinking is
+ * 0.25, which is far enough from the threshold to grow the table.
+ * Failing to allocate a smaller table is not an error; the current
+ * table is kept.
+ */
+static void map_shrink(ngtcp2_map *map) {
+  if (map->tablelenbits <= NGTCP2_INITIAL_TABLE_LENBITS ||
+      map->size * 8 > map->tablelen) {
+    return;
+  }
+
+  map_resize(map, map->tablelen / 2, map->tablelenbits - 1);
+}
+
 int ngtcp2_map_insert(ngtcp2_map *map, ngtcp2_map_key_type key, void *data) {
   int rv;
 
@@ -316,6 +333,8 @@ int ngtcp2_map_remove(ngtcp2_map *map, ngtcp2_map_key_type key) {
 
       --map->size;
 
+      map_shrink(map);
+
       return 0;
     }
 
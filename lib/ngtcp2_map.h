@@ -94,7 +94,8 @@ void *ngtcp2_map_find(ngtcp2_map *map, ngtcp2_map_key_type key);
 
 /*
  * Removes the data associated by the key |key| from the |map|.  The
- * removed data is not freed by this function.
+ * removed data is not freed by this function.  The table shrinks when
+ * it becomes sparse.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -26,6 +26,8 @@
 #include "ngtcp2_mem.h"
 
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
 
 static void *default_malloc(size_t size, void *user_data) {
   (void)user_data;
@@ -56,6 +58,156 @@ static const ngtcp2_mem mem_default = {NULL, default_malloc, default_free,
 
 const ngtcp2_mem *ngtcp2_mem_default(void) { return &mem_default; }
 
+/* ngtcp2_mem_acct_hd is the header which precedes each allocation
+   made through ngtcp2_mem_acct.  Its size keeps the alignment that
+   the underlying allocator guarantees. */
+typedef struct ngtcp2_mem_acct_hd {
+  uint64_t size;
+  uint64_t subsys;
+} ngtcp2_mem_acct_hd;
+
+static void mem_acct_add(ngtcp2_mem_acct *acct, ngtcp2_mem_subsys subsys,
+                         size_t size) {
+  acct->bytes[subsys] += size;
+  acct->total += size;
+  if (acct->peak < acct->total) {
+    acct->peak = acct->total;
+  }
+}
+
+static void mem_acct_sub(ngtcp2_mem_acct *acct, ngtcp2_mem_acct_hd *hd) {
+  acct->bytes[hd->subsys] -= hd->size;
+  acct->total -= hd->size;
+}
+
+static void *mem_acct_malloc(size_t size, void *user_data) {
+  ngtcp2_mem_acct_mem *am = user_data;
+  ngtcp2_mem_acct_hd *hd;
+
+  if (size > SIZE_MAX - sizeof(*hd)) {
+    return NULL;
+  }
+
+  hd = ngtcp2_mem_malloc(am->acct->mem, sizeof(*hd) + size);
+  if (hd == NULL) {
+    return NULL;
+  }
+
+  hd->size = size;
+  hd->subsys = am->subsys;
+
+  mem_acct_add(am->acct, am->subsys, size);
+
+  return hd + 1;
+}
+
+static void mem_acct_free(void *ptr, void *user_data) {
+  ngtcp2_mem_acct_mem *am = user_data;
+  ngtcp2_mem_acct_hd *hd;
+
+  if (ptr == NULL) {
+    return;
+  }
+
+  hd = (ngtcp2_mem_acct_hd *)ptr - 1;
+
+  mem_acct_sub(am->acct, hd);
+
+  ngtcp2_mem_free(am->acct->mem, hd);
+}
+
+static void *mem_acct_calloc(size_t nmemb, size_t size, void *user_data) {
+  void *p;
+
+  if (size && nmemb > SIZE_MAX / size) {
+    return NULL;
+  }
+
+  p = mem_acct_malloc(nmemb * size, user_data);
+  if (p == NULL) {
+    return NULL;
+  }
+
+  memset(p, 0, nmemb * size);
+
+  return p;
+}
+
+static void *mem_acct_realloc(void *ptr, size_t size, void *user_data) {
+  ngtcp2_mem_acct_mem *am = user_data;
+  ngtcp2_mem_acct_hd *hd, *nhd;
+  ngtcp2_mem_subsys subsys;
+
+  if (ptr == NULL) {
+    return mem_acct_malloc(size, user_data);
+  }
+
+  if (size == 0) {
+    mem_acct_free(ptr, user_data);
+    return NULL;
+  }
+
+  if (size > SIZE_MAX - sizeof(*hd)) {
+    return NULL;
+  }
+
+  hd = (ngtcp2_mem_acct_hd *)ptr - 1;
+
+  nhd = ngtcp2_mem_realloc(am->acct->mem, hd, sizeof(*hd) + size);
+  if (nhd == NULL) {
+    return NULL;
+  }
+
+  subsys = (ngtcp2_mem_subsys)nhd->subsys;
+
+  mem_acct_sub(am->acct, nhd);
+
+  nhd->size = size;
+
+  mem_acct_add(am->acct, subsys, size);
+
+  return nhd + 1;
+}
+
+void ngtcp2_mem_acct_init(ngtcp2_mem_acct *acct, const ngtcp2_mem *mem) {
+  size_t i;
+
+  memset(acct, 0, sizeof(*acct));
+
+  acct->mem = mem;
+
+  for (i = 0; i < NGTCP2_MEM_SUBSYS_MAX; ++i) {
+    acct->mems[i].mem.user_data = &acct->mems[i];
+    acct->mems[i].mem.malloc = mem_acct_malloc;
+    acct->mems[i].mem.free = mem_acct_free;
+    acct->mems[i].mem.calloc = mem_acct_calloc;
+    acct->mems[i].mem.realloc = mem_acct_realloc;
+    acct->mems[i].acct = acct;
+    acct->mems[i].subsys = (ngtcp2_mem_subsys)i;
+  }
+}
+
+const ngtcp2_mem *ngtcp2_mem_acct_get(ngtcp2_mem_acct *acct,
+                                      ngtcp2_mem_subsys subsys) {
+  return &acct->mems[subsys].mem;
+}
+
+const ngtcp2_mem *ngtcp2_mem_for_subsys(const ngtcp2_mem *mem,
+                                        ngtcp2_mem_subsys subsys) {
+  ngtcp2_mem_acct_mem *am;
+
+  if (mem->malloc != mem_acct_malloc) {
+    return mem;
+  }
+
+  am = mem->user_data;
+  if (am->subsys != NGTCP2_MEM_SUBSYS_OTHER) {
+    return mem;
+  }
+
+  return &am->acct->mems[subsys].mem;
+}
+
 #ifndef MEMDEBUG
 void *ngtcp2_mem_malloc(const ngtcp2_mem *mem, size_t size) {
   return mem->malloc(size, mem->user_data);
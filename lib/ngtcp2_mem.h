@@ -32,6 +32,62 @@
 
 #include <ngtcp2/ngtcp2.h>
 
+/* ngtcp2_mem_subsys is the subsystem which memory allocated through
+   ngtcp2_mem_acct is attributed to. */
+typedef enum ngtcp2_mem_subsys {
+  NGTCP2_MEM_SUBSYS_OTHER,
+  NGTCP2_MEM_SUBSYS_KSL,
+  NGTCP2_MEM_SUBSYS_ROB,
+  NGTCP2_MEM_SUBSYS_BALLOC,
+  NGTCP2_MEM_SUBSYS_CRYPTO,
+  NGTCP2_MEM_SUBSYS_DGRAM,
+  NGTCP2_MEM_SUBSYS_MAX,
+} ngtcp2_mem_subsys;
+
+struct ngtcp2_mem_acct;
+
+/* ngtcp2_mem_acct_mem is ngtcp2_mem which attributes the allocations
+   to |subsys| of |acct|. */
+typedef struct ngtcp2_mem_acct_mem {
+  ngtcp2_mem mem;
+  struct ngtcp2_mem_acct *acct;
+  ngtcp2_mem_subsys subsys;
+} ngtcp2_mem_acct_mem;
+
+/* ngtcp2_mem_acct is an accounting allocator which wraps |mem| and
+   counts the number of bytes allocated per subsystem.  Each
+   allocation is prefixed with a small header that records its size
+   and subsystem, so that any of its ngtcp2_mem can free or
+   reallocate the memory allocated by the others. */
+typedef struct ngtcp2_mem_acct {
+  /* mem is the underlying allocator. */
+  const ngtcp2_mem *mem;
+  ngtcp2_mem_acct_mem mems[NGTCP2_MEM_SUBSYS_MAX];
+  /* bytes is the number of bytes allocated per subsystem. */
+  uint64_t bytes[NGTCP2_MEM_SUBSYS_MAX];
+  /* total is the sum of bytes. */
+  uint64_t total;
+  /* peak is the largest value that total has ever reached. */
+  uint64_t peak;
+} ngtcp2_mem_acct;
+
+/* ngtcp2_mem_acct_init initializes |acct| which allocates memory from
+   |mem|.  |acct| must not be moved after this call. */
+void ngtcp2_mem_acct_init(ngtcp2_mem_acct *acct, const ngtcp2_mem *mem);
+
+/* ngtcp2_mem_acct_get returns ngtcp2_mem which attributes the
+   allocations to |subsys|. */
+const ngtcp2_mem *ngtcp2_mem_acct_get(ngtcp2_mem_acct *acct,
+                                      ngtcp2_mem_subsys subsys);
+
+/* ngtcp2_mem_for_subsys returns ngtcp2_mem which attributes the
+   allocations to |subsys| if |mem| is obtained from
+   ngtcp2_mem_acct_get with NGTCP2_MEM_SUBSYS_OTHER.  Otherwise, it
+   returns |mem|, so that the memory already attributed to a more
+   specific subsystem stays there. */
+const ngtcp2_mem *ngtcp2_mem_for_subsys(const ngtcp2_mem *mem,
+                                        ngtcp2_mem_subsys subsys);
+
 /* Convenient wrapper functions to call allocator function in
    |mem|. */
 #ifndef MEMDEBUG
@@ -26,15 +26,145 @@
 
 void ngtcp2_objalloc_init(ngtcp2_objalloc *objalloc, size_t blklen,
                           const ngtcp2_mem *mem) {
+  size_t i;
+
   ngtcp2_balloc_init(&objalloc->balloc, blklen, mem);
   ngtcp2_opl_init(&objalloc->opl);
+
+  for (i = 0; i < NGTCP2_OBJALLOC_MAX_SIZE_CLASS; ++i) {
+    ngtcp2_opl_init(&objalloc->sized_opl[i]);
+  }
+
+  objalloc->nused = 0;
+  objalloc->max_cached = 0;
+  objalloc->ncached = 0;
+  objalloc->oploff = 0;
+  objalloc->nreused = 0;
+  objalloc->nallocated = 0;
+}
+
+void ngtcp2_objalloc_heap_init(ngtcp2_objalloc *objalloc, size_t max_cached,
+                               size_t oploff, const ngtcp2_mem *mem) {
+  assert(max_cached);
+
+  ngtcp2_objalloc_init(objalloc, 0, mem);
+
+  objalloc->max_cached = max_cached;
+  objalloc->oploff = oploff;
+}
+
+/*
+ * heap_opl_free frees the objects kept in |opl|.
+ */
+static void heap_opl_free(ngtcp2_objalloc *objalloc, ngtcp2_opl *opl) {
+  ngtcp2_opl_entry *oplent;
+
+  for (; (oplent = ngtcp2_opl_pop(opl));) {
+    ngtcp2_mem_free(objalloc->balloc.mem,
+                    (uint8_t *)oplent - objalloc->oploff);
+    --objalloc->ncached;
+  }
+}
+
+/*
+ * heap_free frees all objects kept for reuse.
+ */
+static void heap_free(ngtcp2_objalloc *objalloc) {
+  size_t i;
+
+  heap_opl_free(objalloc, &objalloc->opl);
+
+  for (i = 0; i < NGTCP2_OBJALLOC_MAX_SIZE_CLASS; ++i) {
+    heap_opl_free(objalloc, &objalloc->sized_opl[i]);
+  }
+
+  assert(objalloc->ncached == 0);
 }
 
 void ngtcp2_objalloc_free(ngtcp2_objalloc *objalloc) {
+  if (objalloc->max_cached) {
+    heap_free(objalloc);
+    return;
+  }
+
   ngtcp2_balloc_free(&objalloc->balloc);
 }
 
 void ngtcp2_objalloc_clear(ngtcp2_objalloc *objalloc) {
+  size_t i;
+
+  if (objalloc->max_cached) {
+    heap_free(objalloc);
+    return;
+  }
+
   ngtcp2_opl_clear(&objalloc->opl);
+
+  for (i = 0; i < NGTCP2_OBJALLOC_MAX_SIZE_CLASS; ++i) {
+    ngtcp2_opl_clear(&objalloc->sized_opl[i]);
+  }
+
   ngtcp2_balloc_clear(&objalloc->balloc);
+
+  objalloc->nused = 0;
+}
+
+int ngtcp2_objalloc_shrink(ngtcp2_objalloc *objalloc) {
+  if (objalloc->max_cached) {
+    if (objalloc->ncached == 0) {
+      return 0;
+    }
+
+    heap_free(objalloc);
+
+    return 1;
+  }
+
+  if (objalloc->nused || objalloc->balloc.head == NULL) {
+    return 0;
+  }
+
+  ngtcp2_objalloc_clear(objalloc);
+
+  return 1;
+}
+
+void *ngtcp2_objalloc_heap_get(ngtcp2_objalloc *objalloc, ngtcp2_opl *opl,
+                               size_t len) {
+  ngtcp2_opl_entry *oplent = ngtcp2_opl_pop(opl);
+  void *obj;
+
+  if (oplent) {
+    --objalloc->ncached;
+    ++objalloc->nreused;
+    ++objalloc->nused;
+
+    return (uint8_t *)oplent - objalloc->oploff;
+  }
+
+  obj = ngtcp2_mem_malloc(objalloc->balloc.mem, len);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  ++objalloc->nallocated;
+  ++objalloc->nused;
+
+  return obj;
+}
+
+void ngtcp2_objalloc_heap_release(ngtcp2_objalloc *objalloc, ngtcp2_opl *opl,
+                                  void *obj, ngtcp2_opl_entry *oplent) {
+  assert(objalloc->nused);
+
+  --objalloc->nused;
+
+  if (objalloc->ncached < objalloc->max_cached) {
+    ngtcp2_opl_push(opl, oplent);
+    ++objalloc->ncached;
+
+    return;
+  }
+
+  ngtcp2_mem_free(objalloc->balloc.mem, obj);
 }
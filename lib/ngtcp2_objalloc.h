@@ -29,6 +29,9 @@
 #  include <config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <assert.h>
+#include <stddef.h>
+
 #include <ngtcp2/ngtcp2.h>
 
 #include "ngtcp2_balloc.h"
@@ -36,6 +39,11 @@
 #include "ngtcp2_macro.h"
 #include "ngtcp2_mem.h"
 
+/* NGTCP2_OBJALLOC_MAX_SIZE_CLASS is the number of additional size
+   classes that ngtcp2_objalloc pools.  The size of each class is
+   decided by the user. */
+#define NGTCP2_OBJALLOC_MAX_SIZE_CLASS 2
+
 /*
  * ngtcp2_objalloc combines ngtcp2_balloc and ngtcp2_opl, and provides
  * an object pool with the custom allocator to reduce the allocation
@@ -44,6 +52,28 @@
 typedef struct ngtcp2_objalloc {
   ngtcp2_balloc balloc;
   ngtcp2_opl opl;
+  /* sized_opl pools objects which are larger than the base type.
+     sized_opl[i] holds the objects of size class i. */
+  ngtcp2_opl sized_opl[NGTCP2_OBJALLOC_MAX_SIZE_CLASS];
+  /* nused is the number of objects which have been handed out, and
+     not released yet.  It is always 0 if NOMEMPOOL is defined. */
+  size_t nused;
+  /* max_cached, if nonzero, makes objalloc allocate objects from the
+     heap one by one instead of from balloc, and keep at most
+     max_cached released objects for reuse.  Such objalloc can free
+     any object, and is used as a pool shared by connections. */
+  size_t max_cached;
+  /* ncached is the number of released objects kept for reuse if
+     max_cached is nonzero. */
+  size_t ncached;
+  /* oploff is the offset of ngtcp2_opl_entry in the object. */
+  size_t oploff;
+  /* nreused is the number of objects handed out from the released
+     objects if max_cached is nonzero. */
+  uint64_t nreused;
+  /* nallocated is the number of objects allocated from the heap if
+     max_cached is nonzero. */
+  uint64_t nallocated;
 } ngtcp2_objalloc;
 
 /*
@@ -64,6 +94,37 @@ void ngtcp2_objalloc_free(ngtcp2_objalloc *objalloc);
  */
 void ngtcp2_objalloc_clear(ngtcp2_objalloc *objalloc);
 
+/*
+ * ngtcp2_objalloc_shrink releases all allocated resources if no
+ * object is in use.  It returns nonzero if it released them.
+ */
+int ngtcp2_objalloc_shrink(ngtcp2_objalloc *objalloc);
+
+/*
+ * ngtcp2_objalloc_heap_init initializes |objalloc| which allocates
+ * objects from the heap, and keeps at most |max_cached| released
+ * objects for reuse.  |max_cached| must not be 0.  |oploff| is the
+ * offset of ngtcp2_opl_entry in the object.
+ */
+void ngtcp2_objalloc_heap_init(ngtcp2_objalloc *objalloc, size_t max_cached,
+                               size_t oploff, const ngtcp2_mem *mem);
+
+/*
+ * ngtcp2_objalloc_heap_get returns the object of |len| bytes taken
+ * from |opl|, or allocated from the heap.  It returns NULL if it
+ * cannot allocate memory.
+ */
+void *ngtcp2_objalloc_heap_get(ngtcp2_objalloc *objalloc, ngtcp2_opl *opl,
+                               size_t len);
+
+/*
+ * ngtcp2_objalloc_heap_release keeps |obj| in |opl| for reuse, or
+ * frees it if |objalloc| already keeps max_cached objects.  |oplent|
+ * is the ngtcp2_opl_entry of |obj|.
+ */
+void ngtcp2_objalloc_heap_release(ngtcp2_objalloc *objalloc, ngtcp2_opl *opl,
+                                  void *obj, ngtcp2_opl_entry *oplent);
+
 #ifndef NOMEMPOOL
 #  define ngtcp2_objalloc_def(NAME, TYPE, OPLENTFIELD)                         \
     inline static void ngtcp2_objalloc_##NAME##_init(                          \
@@ -72,12 +133,24 @@ void ngtcp2_objalloc_clear(ngtcp2_objalloc *objalloc);
           objalloc, ((sizeof(TYPE) + 0xfu) & ~(uintptr_t)0xfu) * nmemb, mem);  \
     }                                                                          \
                                                                                \
+    inline static void ngtcp2_objalloc_##NAME##_heap_init(                     \
+        ngtcp2_objalloc *objalloc, size_t max_cached, const ngtcp2_mem *mem) { \
+      ngtcp2_objalloc_heap_init(objalloc, max_cached,                          \
+                                offsetof(TYPE, OPLENTFIELD), mem);             \
+    }                                                                          \
+                                                                               \
     inline static TYPE *ngtcp2_objalloc_##NAME##_get(                          \
         ngtcp2_objalloc *objalloc) {                                           \
-      ngtcp2_opl_entry *oplent = ngtcp2_opl_pop(&objalloc->opl);               \
+      ngtcp2_opl_entry *oplent;                                                \
       TYPE *obj;                                                               \
       int rv;                                                                  \
                                                                                \
+      if (objalloc->max_cached) {                                              \
+        return ngtcp2_objalloc_heap_get(objalloc, &objalloc->opl,              \
+                                        sizeof(TYPE));                         \
+      }                                                                        \
+                                                                               \
+      oplent = ngtcp2_opl_pop(&objalloc->opl);                                 \
       if (!oplent) {                                                           \
         rv =                                                                   \
             ngtcp2_balloc_get(&objalloc->balloc, (void **)&obj, sizeof(TYPE)); \
@@ -85,33 +158,94 @@ void ngtcp2_objalloc_clear(ngtcp2_objalloc *objalloc);
           return NULL;                                                         \
         }                                                                      \
                                                                                \
+        ++objalloc->nused;                                                     \
         return obj;                                                            \
       }                                                                        \
                                                                                \
+      ++objalloc->nused;                                                       \
       return ngtcp2_struct_of(oplent, TYPE, OPLENTFIELD);                      \
     }                                                                          \
                                                                                \
     inline static TYPE *ngtcp2_objalloc_##NAME##_len_get(                      \
         ngtcp2_objalloc *objalloc, size_t len) {                               \
-      ngtcp2_opl_entry *oplent = ngtcp2_opl_pop(&objalloc->opl);               \
+      ngtcp2_opl_entry *oplent;                                                \
       TYPE *obj;                                                               \
       int rv;                                                                  \
                                                                                \
+      if (objalloc->max_cached) {                                              \
+        return ngtcp2_objalloc_heap_get(objalloc, &objalloc->opl, len);        \
+      }                                                                        \
+                                                                               \
+      oplent = ngtcp2_opl_pop(&objalloc->opl);                                 \
       if (!oplent) {                                                           \
         rv = ngtcp2_balloc_get(&objalloc->balloc, (void **)&obj, len);         \
         if (rv != 0) {                                                         \
           return NULL;                                                         \
         }                                                                      \
                                                                                \
+        ++objalloc->nused;                                                     \
         return obj;                                                            \
       }                                                                        \
                                                                                \
+      ++objalloc->nused;                                                       \
+      return ngtcp2_struct_of(oplent, TYPE, OPLENTFIELD);                      \
+    }                                                                          \
+                                                                               \
+    inline static TYPE *ngtcp2_objalloc_##NAME##_sized_get(                    \
+        ngtcp2_objalloc *objalloc, size_t size_class, size_t len) {            \
+      ngtcp2_opl_entry *oplent;                                                \
+      TYPE *obj;                                                               \
+      int rv;                                                                  \
+                                                                               \
+      assert(size_class < NGTCP2_OBJALLOC_MAX_SIZE_CLASS);                     \
+                                                                               \
+      if (objalloc->max_cached) {                                              \
+        return ngtcp2_objalloc_heap_get(                                       \
+            objalloc, &objalloc->sized_opl[size_class], len);                  \
+      }                                                                        \
+                                                                               \
+      oplent = ngtcp2_opl_pop(&objalloc->sized_opl[size_class]);               \
+      if (!oplent) {                                                           \
+        rv = ngtcp2_balloc_get(&objalloc->balloc, (void **)&obj, len);         \
+        if (rv != 0) {                                                         \
+          return NULL;                                                         \
+        }                                                                      \
+                                                                               \
+        ++objalloc->nused;                                                     \
+        return obj;                                                            \
+      }                                                                        \
+                                                                               \
+      ++objalloc->nused;                                                       \
       return ngtcp2_struct_of(oplent, TYPE, OPLENTFIELD);                      \
     }                                                                          \
                                                                                \
     inline static void ngtcp2_objalloc_##NAME##_release(                       \
         ngtcp2_objalloc *objalloc, TYPE *obj) {                                \
+      if (objalloc->max_cached) {                                              \
+        ngtcp2_objalloc_heap_release(objalloc, &objalloc->opl, obj,            \
+                                     &obj->OPLENTFIELD);                       \
+        return;                                                                \
+      }                                                                        \
+                                                                               \
+      assert(objalloc->nused);                                                 \
+      --objalloc->nused;                                                       \
       ngtcp2_opl_push(&objalloc->opl, &obj->OPLENTFIELD);                      \
+    }                                                                          \
+                                                                               \
+    inline static void ngtcp2_objalloc_##NAME##_sized_release(                 \
+        ngtcp2_objalloc *objalloc, size_t size_class, TYPE *obj) {             \
+      assert(size_class < NGTCP2_OBJALLOC_MAX_SIZE_CLASS);                     \
+                                                                               \
+      if (objalloc->max_cached) {                                              \
+        ngtcp2_objalloc_heap_release(objalloc,                                 \
+                                     &objalloc->sized_opl[size_class], obj,    \
+                                     &obj->OPLENTFIELD);                       \
+        return;                                                                \
+      }                                                                        \
+                                                                               \
+      assert(objalloc->nused);                                                 \
+      --objalloc->nused;                                                       \
+      ngtcp2_opl_push(&objalloc->sized_opl[size_class], &obj->OPLENTFIELD);    \
     }
 #else /* NOMEMPOOL */
 #  define ngtcp2_objalloc_def(NAME, TYPE, OPLENTFIELD)                         \
@@ -121,6 +255,12 @@ void ngtcp2_objalloc_clear(ngtcp2_objalloc *objalloc);
           objalloc, ((sizeof(TYPE) + 0xfu) & ~(uintptr_t)0xfu) * nmemb, mem);  \
     }                                                                          \
                                                                                \
+    inline static void ngtcp2_objalloc_##NAME##_heap_init(                     \
+        ngtcp2_objalloc *objalloc, size_t max_cached, const ngtcp2_mem *mem) { \
+      ngtcp2_objalloc_heap_init(objalloc, max_cached,                          \
+                                offsetof(TYPE, OPLENTFIELD), mem);             \
+    }                                                                          \
+                                                                               \
     inline static TYPE *ngtcp2_objalloc_##NAME##_get(                          \
         ngtcp2_objalloc *objalloc) {                                           \
       return ngtcp2_mem_malloc(objalloc->balloc.mem, sizeof(TYPE));            \
@@ -131,9 +271,21 @@ void ngtcp2_objalloc_clear(ngtcp2_objalloc *objalloc);
       return ngtcp2_mem_malloc(objalloc->balloc.mem, len);                     \
     }                                                                          \
                                                                                \
+    inline static TYPE *ngtcp2_objalloc_##NAME##_sized_get(                    \
+        ngtcp2_objalloc *objalloc, size_t size_class, size_t len) {            \
+      (void)size_class;                                                        \
+      return ngtcp2_mem_malloc(objalloc->balloc.mem, len);                     \
+    }                                                                          \
+                                                                               \
     inline static void ngtcp2_objalloc_##NAME##_release(                       \
         ngtcp2_objalloc *objalloc, TYPE *obj) {                                \
       ngtcp2_mem_free(objalloc->balloc.mem, obj);                              \
+    }                                                                          \
+                                                                               \
+    inline static void ngtcp2_objalloc_##NAME##_sized_release(                 \
+        ngtcp2_objalloc *objalloc, size_t size_class, TYPE *obj) {             \
+      (void)size_class;                                                        \
+      ngtcp2_mem_free(objalloc->balloc.mem, obj);                              \
     }
 #endif /* NOMEMPOOL */
 
@@ -0,0 +1,89 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_perf.h"
+
+#include <string.h>
+
+#ifdef PERFSTAT
+#  ifdef _WIN32
+#    include <windows.h>
+#  else /* !_WIN32 */
+#    include <time.h>
+#  endif /* !_WIN32 */
+#endif   /* PERFSTAT */
+
+void ngtcp2_perf_init(ngtcp2_perf *perf, int enabled) {
+  memset(perf, 0, sizeof(*perf));
+
+#ifdef PERFSTAT
+  perf->enabled = enabled;
+#else  /* !PERFSTAT */
+  (void)enabled;
+#endif /* !PERFSTAT */
+}
+
+#ifdef PERFSTAT
+/*
+ * perf_now returns the current value of the monotonic clock in
+ * nanoseconds.
+ */
+static uint64_t perf_now(void) {
+#  ifdef _WIN32
+  LARGE_INTEGER freq, cnt;
+
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&cnt);
+
+  return (uint64_t)((double)cnt.QuadPart * 1e9 / (double)freq.QuadPart);
+#  else  /* !_WIN32 */
+  struct timespec tp;
+
+  clock_gettime(CLOCK_MONOTONIC, &tp);
+
+  return (uint64_t)tp.tv_sec * NGTCP2_SECONDS + (uint64_t)tp.tv_nsec;
+#  endif /* !_WIN32 */
+}
+
+ngtcp2_perf_phase ngtcp2_perf_switch(ngtcp2_perf *perf,
+                                     ngtcp2_perf_phase phase) {
+  ngtcp2_perf_phase prev = perf->phase;
+  uint64_t now;
+
+  if (!perf->enabled || prev == phase) {
+    return prev;
+  }
+
+  now = perf_now();
+
+  if (prev != NGTCP2_PERF_PHASE_NONE) {
+    perf->ns[prev] += now - perf->last_ts;
+  }
+
+  perf->last_ts = now;
+  perf->phase = phase;
+
+  return prev;
+}
+#endif /* PERFSTAT */
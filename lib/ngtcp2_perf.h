@@ -0,0 +1,91 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGTCP2_PERF_H
+#define NGTCP2_PERF_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <ngtcp2/ngtcp2.h>
+
+/* ngtcp2_perf_phase is the processing phase of a connection which CPU
+   time is attributed to. */
+typedef enum ngtcp2_perf_phase {
+  /* NGTCP2_PERF_PHASE_NONE is the time spent outside of the library,
+     and it is not counted. */
+  NGTCP2_PERF_PHASE_NONE,
+  NGTCP2_PERF_PHASE_OTHER,
+  NGTCP2_PERF_PHASE_DECRYPT,
+  NGTCP2_PERF_PHASE_FRAME_DECODE,
+  NGTCP2_PERF_PHASE_ACK,
+  NGTCP2_PERF_PHASE_LOSS_DETECTION,
+  NGTCP2_PERF_PHASE_CC,
+  NGTCP2_PERF_PHASE_ENCRYPT,
+  NGTCP2_PERF_PHASE_MAX,
+} ngtcp2_perf_phase;
+
+/* ngtcp2_perf accumulates the CPU time spent in each phase.  The
+   phases do not overlap: entering a phase stops the clock of the
+   current one, so that the time spent in a nested phase is not
+   counted twice. */
+typedef struct ngtcp2_perf {
+  /* ns is the total time in nanoseconds spent in each phase. */
+  uint64_t ns[NGTCP2_PERF_PHASE_MAX];
+  /* last_ts is the time when the current phase was entered or
+     resumed. */
+  uint64_t last_ts;
+  /* phase is the current phase. */
+  ngtcp2_perf_phase phase;
+  /* enabled is nonzero if the time is measured. */
+  int enabled;
+} ngtcp2_perf;
+
+/*
+ * ngtcp2_perf_init initializes |perf|.  The time is measured only if
+ * |enabled| is nonzero and the library is built with PERFSTAT.
+ */
+void ngtcp2_perf_init(ngtcp2_perf *perf, int enabled);
+
+#ifdef PERFSTAT
+/*
+ * ngtcp2_perf_switch charges the time elapsed since the last switch
+ * to the current phase, and makes |phase| current.  It returns the
+ * previous phase, which the caller passes to this function again to
+ * resume it.
+ */
+ngtcp2_perf_phase ngtcp2_perf_switch(ngtcp2_perf *perf,
+                                     ngtcp2_perf_phase phase);
+#else /* !PERFSTAT */
+static inline ngtcp2_perf_phase ngtcp2_perf_switch(ngtcp2_perf *perf,
+                                                   ngtcp2_perf_phase phase) {
+  (void)perf;
+  (void)phase;
+
+  return NGTCP2_PERF_PHASE_NONE;
+}
+#endif /* !PERFSTAT */
+
+#endif /* NGTCP2_PERF_H */
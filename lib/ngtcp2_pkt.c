@@ -34,30 +34,27 @@
 #include "ngtcp2_mem.h"
 #include "ngtcp2_vec.h"
 
-int ngtcp2_pkt_chain_new(ngtcp2_pkt_chain **ppc, const ngtcp2_path *path,
-                         const ngtcp2_pkt_info *pi, const uint8_t *pkt,
-                         size_t pktlen, size_t dgramlen, ngtcp2_tstamp ts,
-                         const ngtcp2_mem *mem) {
-  *ppc = ngtcp2_mem_malloc(mem, sizeof(ngtcp2_pkt_chain) + pktlen);
-  if (*ppc == NULL) {
-    return NGTCP2_ERR_NOMEM;
-  }
+size_t ngtcp2_pkt_chain_objlen(size_t pktlen) {
+  return (sizeof(ngtcp2_pkt_chain) + pktlen + 7) & ~(size_t)7;
+}
 
-  ngtcp2_path_storage_init2(&(*ppc)->path, path);
-  (*ppc)->pi = *pi;
-  (*ppc)->next = NULL;
-  (*ppc)->pkt = (uint8_t *)(*ppc) + sizeof(ngtcp2_pkt_chain);
-  (*ppc)->pktlen = pktlen;
-  (*ppc)->dgramlen = dgramlen;
-  (*ppc)->ts = ts;
+ngtcp2_pkt_chain *ngtcp2_pkt_chain_init(uint8_t *p, const ngtcp2_path *path,
+                                        const ngtcp2_pkt_info *pi,
+                                        const uint8_t *pkt, size_t pktlen,
+                                        size_t dgramlen, ngtcp2_tstamp ts) {
+  ngtcp2_pkt_chain *pc = (ngtcp2_pkt_chain *)(void *)p;
 
-  memcpy((*ppc)->pkt, pkt, pktlen);
+  ngtcp2_path_storage_init2(&pc->path, path);
+  pc->pi = *pi;
+  pc->next = NULL;
+  pc->pkt = p + sizeof(ngtcp2_pkt_chain);
+  pc->pktlen = pktlen;
+  pc->dgramlen = dgramlen;
+  pc->ts = ts;
 
-  return 0;
-}
+  memcpy(pc->pkt, pkt, pktlen);
 
-void ngtcp2_pkt_chain_del(ngtcp2_pkt_chain *pc, const ngtcp2_mem *mem) {
-  ngtcp2_mem_free(mem, pc);
+  return pc;
 }
 
 int ngtcp2_pkt_decode_version_cid(ngtcp2_version_cid *dest, const uint8_t *data,
@@ -138,6 +135,55 @@ int ngtcp2_pkt_decode_version_cid(ngtcp2_version_cid *dest, const uint8_t *data,
   return 0;
 }
 
+static int pkt_batch_entry_same_dcid(const ngtcp2_pkt_batch_entry *a,
+                                     const ngtcp2_pkt_batch_entry *b) {
+  if (a->rv == NGTCP2_ERR_INVALID_ARGUMENT ||
+      b->rv == NGTCP2_ERR_INVALID_ARGUMENT) {
+    return 0;
+  }
+
+  return a->vc.dcidlen == b->vc.dcidlen &&
+         (a->vc.dcidlen == 0 ||
+          memcmp(a->vc.dcid, b->vc.dcid, a->vc.dcidlen) == 0);
+}
+
+size_t ngtcp2_pkt_group_by_dcid(ngtcp2_pkt_batch_entry *dest,
+                                const ngtcp2_vec *dgrams, size_t n,
+                                size_t short_dcidlen) {
+  ngtcp2_pkt_batch_entry ent;
+  size_t i, j, k;
+  size_t ngroups = 0;
+
+  for (i = 0; i < n; ++i) {
+    dest[i].index = i;
+    dest[i].rv = ngtcp2_pkt_decode_version_cid(
+      &dest[i].vc, dgrams[i].base, dgrams[i].len, short_dcidlen);
+  }
+
+  /* dest[i] is the first datagram of a group.  Move the datagrams of
+     the same group which follow it right after dest[k - 1] keeping
+     the order of the others. */
+  for (i = 0; i < n; i = k) {
+    ++ngroups;
+
+    for (j = k = i + 1; j < n; ++j) {
+      if (!pkt_batch_entry_same_dcid(&dest[i], &dest[j])) {
+        continue;
+      }
+
+      if (j != k) {
+        ent = dest[j];
+        memmove(&dest[k + 1], &dest[k], sizeof(dest[0]) * (j - k));
+        dest[k] = ent;
+      }
+
+      ++k;
+    }
+  }
+
+  return ngroups;
+}
+
 void ngtcp2_pkt_hd_init(ngtcp2_pkt_hd *hd, uint8_t flags, uint8_t type,
                         const ngtcp2_cid *dcid, const ngtcp2_cid *scid,
                         int64_t pkt_num, size_t pkt_numlen, uint32_t version,
@@ -357,6 +403,11 @@ ngtcp2_ssize ngtcp2_pkt_decode_hd_short(ngtcp2_pkt_hd *dest, const uint8_t *pkt,
     flags |= NGTCP2_PKT_FLAG_FIXED_BIT_CLEAR;
   }
 
+  /* Spin bit is not protected by header protection. */
+  if (pkt[0] & NGTCP2_SHORT_SPIN_BIT_MASK) {
+    flags |= NGTCP2_PKT_FLAG_SPIN_BIT;
+  }
+
   p = &pkt[1];
 
   dest->type = NGTCP2_PKT_1RTT;
@@ -456,6 +507,9 @@ ngtcp2_ssize ngtcp2_pkt_encode_hd_short(uint8_t *out, size_t outlen,
   if (hd->flags & NGTCP2_PKT_FLAG_KEY_PHASE) {
     *p |= NGTCP2_SHORT_KEY_PHASE_BIT;
   }
+  if (hd->flags & NGTCP2_PKT_FLAG_SPIN_BIT) {
+    *p |= NGTCP2_SHORT_SPIN_BIT_MASK;
+  }
 
   ++p;
 
@@ -543,10 +597,25 @@ ngtcp2_ssize ngtcp2_pkt_decode_frame(ngtcp2_frame *dest, const uint8_t *payload,
   case NGTCP2_FRAME_DATAGRAM_LEN:
     return ngtcp2_pkt_decode_datagram_frame(&dest->datagram, payload,
                                             payloadlen);
+  case NGTCP2_FRAME_IMMEDIATE_ACK:
+    return ngtcp2_pkt_decode_immediate_ack_frame(&dest->immediate_ack,
+                                                 payload, payloadlen);
   default:
     if (has_mask(type, NGTCP2_FRAME_STREAM)) {
       return ngtcp2_pkt_decode_stream_frame(&dest->stream, payload, payloadlen);
     }
+    /* ACK_FREQUENCY frame type is 2 bytes long.  Frame type must be
+       encoded in the shortest form. */
+    if (type == 0x40 && payloadlen >= 2 &&
+        payload[1] == NGTCP2_FRAME_ACK_FREQUENCY) {
+      return ngtcp2_pkt_decode_ack_frequency_frame(&dest->ack_frequency,
+                                                   payload, payloadlen);
+    }
+    if (type == 0x40 && payloadlen >= 2 &&
+        payload[1] == NGTCP2_FRAME_REPAIR) {
+      return ngtcp2_pkt_decode_repair_frame(&dest->repair, payload,
+                                            payloadlen);
+    }
     return NGTCP2_ERR_FRAME_ENCODING;
   }
 }
@@ -555,89 +624,47 @@ ngtcp2_ssize ngtcp2_pkt_decode_stream_frame(ngtcp2_stream *dest,
                                             const uint8_t *payload,
                                             size_t payloadlen) {
   uint8_t type;
-  size_t len = 1 + 1;
-  const uint8_t *p;
+  const uint8_t *p, *end;
   size_t datalen;
-  size_t ndatalen = 0;
-  size_t n;
-  uint64_t vi;
+  size_t n = 1;
+  ngtcp2_ssize nread;
+  /* v holds Stream ID, and then Offset and Length if present. */
+  uint64_t v[3];
 
-  if (payloadlen < len) {
+  if (payloadlen < 1 + 1) {
     return NGTCP2_ERR_FRAME_ENCODING;
   }
 
   type = payload[0];
 
   p = payload + 1;
+  end = payload + payloadlen;
 
-  n = ngtcp2_get_varint_len(p);
-  len += n - 1;
+  n += (type & NGTCP2_STREAM_OFF_BIT) != 0;
+  n += (type & NGTCP2_STREAM_LEN_BIT) != 0;
 
-  if (payloadlen < len) {
+  nread = ngtcp2_get_varints(v, n, p, (size_t)(end - p));
+  if (nread < 0) {
     return NGTCP2_ERR_FRAME_ENCODING;
   }
 
-  p += n;
-
-  if (type & NGTCP2_STREAM_OFF_BIT) {
-    ++len;
-    if (payloadlen < len) {
-      return NGTCP2_ERR_FRAME_ENCODING;
-    }
-
-    n = ngtcp2_get_varint_len(p);
-    len += n - 1;
-
-    if (payloadlen < len) {
-      return NGTCP2_ERR_FRAME_ENCODING;
-    }
-
-    p += n;
-  }
+  p += nread;
 
   if (type & NGTCP2_STREAM_LEN_BIT) {
-    ++len;
-    if (payloadlen < len) {
-      return NGTCP2_ERR_FRAME_ENCODING;
-    }
-
-    ndatalen = ngtcp2_get_varint_len(p);
-    len += ndatalen - 1;
-
-    if (payloadlen < len) {
+    if ((uint64_t)(end - p) < v[n - 1]) {
       return NGTCP2_ERR_FRAME_ENCODING;
     }
 
-    vi = ngtcp2_get_varint(&ndatalen, p);
-    if (payloadlen - len < vi) {
-      return NGTCP2_ERR_FRAME_ENCODING;
-    }
-    datalen = (size_t)vi;
-    len += datalen;
+    datalen = (size_t)v[n - 1];
   } else {
-    len = payloadlen;
+    datalen = (size_t)(end - p);
   }
 
-  p = payload + 1;
-
   dest->type = NGTCP2_FRAME_STREAM;
   dest->flags = (uint8_t)(type & ~NGTCP2_FRAME_STREAM);
   dest->fin = (type & NGTCP2_STREAM_FIN_BIT) != 0;
-  dest->stream_id = (int64_t)ngtcp2_get_varint(&n, p);
-  p += n;
-
-  if (type & NGTCP2_STREAM_OFF_BIT) {
-    dest->offset = ngtcp2_get_varint(&n, p);
-    p += n;
-  } else {
-    dest->offset = 0;
-  }
-
-  if (type & NGTCP2_STREAM_LEN_BIT) {
-    p += ndatalen;
-  } else {
-    datalen = payloadlen - (size_t)(p - payload);
-  }
+  dest->stream_id = (int64_t)v[0];
+  dest->offset = (type & NGTCP2_STREAM_OFF_BIT) ? v[1] : 0;
 
   if (datalen) {
     dest->data[0].len = datalen;
@@ -648,155 +675,102 @@ ngtcp2_ssize ngtcp2_pkt_decode_stream_frame(ngtcp2_stream *dest,
     dest->datacnt = 0;
   }
 
-  assert((size_t)(p - payload) == len);
-
-  return (ngtcp2_ssize)len;
+  return (ngtcp2_ssize)(p - payload);
 }
 
 ngtcp2_ssize ngtcp2_pkt_decode_ack_frame(ngtcp2_ack *dest,
                                          const uint8_t *payload,
                                          size_t payloadlen) {
   size_t num_blks, max_num_blks;
-  size_t nnum_blks;
-  size_t len = 1 + 1 + 1 + 1 + 1;
-  const uint8_t *p;
-  size_t i, j;
+  const uint8_t *p, *end;
+  size_t i, n;
   ngtcp2_ack_blk *blk;
-  size_t n;
+  ngtcp2_ssize nread;
   uint8_t type;
-  uint64_t vi;
+  /* v holds Largest Acknowledged, ACK Delay, ACK Range Count, and
+     First ACK Range in this order, and then ECN Counts. */
+  uint64_t v[4];
+  /* blks holds the pairs of Gap and ACK Range Length. */
+  uint64_t blks[NGTCP2_MAX_ACK_BLKS * 2];
 
-  if (payloadlen < len) {
+  if (payloadlen < 1 + 1 + 1 + 1 + 1) {
     return NGTCP2_ERR_FRAME_ENCODING;
   }
 
   type = payload[0];
 
   p = payload + 1;
+  end = payload + payloadlen;
 
-  /* Largest Acknowledged */
-  n = ngtcp2_get_varint_len(p);
-  len += n - 1;
-
-  if (payloadlen < len) {
+  nread = ngtcp2_get_varints(v, 4, p, (size_t)(end - p));
+  if (nread < 0) {
     return NGTCP2_ERR_FRAME_ENCODING;
   }
 
-  p += n;
-
-  /* ACK Delay */
-  n = ngtcp2_get_varint_len(p);
-  len += n - 1;
+  p += nread;
 
-  if (payloadlen < len) {
+  /* Each ACK Range is at least 2 bytes long. */
+  if (v[2] > (uint64_t)(end - p) / (1 + 1)) {
     return NGTCP2_ERR_FRAME_ENCODING;
   }
 
-  p += n;
+  num_blks = (size_t)v[2];
 
-  /* ACK Block Count */
-  nnum_blks = ngtcp2_get_varint_len(p);
-  len += nnum_blks - 1;
+  max_num_blks = ngtcp2_min(NGTCP2_MAX_ACK_BLKS, num_blks);
 
-  if (payloadlen < len) {
-    return NGTCP2_ERR_FRAME_ENCODING;
-  }
+  dest->type = type;
+  dest->largest_ack = (int64_t)v[0];
+  dest->ack_delay = v[1];
+  /* This value will be assigned in the upper layer. */
+  dest->ack_delay_unscaled = 0;
+  dest->num_blks = (uint32_t)num_blks;
+  dest->first_ack_blklen = v[3];
 
-  vi = ngtcp2_get_varint(&nnum_blks, p);
-  if (vi > SIZE_MAX / (1 + 1) || payloadlen - len < vi * (1 + 1)) {
+  /* Gap, and Additional ACK Block */
+  nread = ngtcp2_get_varints(blks, max_num_blks * 2, p, (size_t)(end - p));
+  if (nread < 0) {
     return NGTCP2_ERR_FRAME_ENCODING;
   }
 
-  num_blks = (size_t)vi;
-  len += num_blks * (1 + 1);
+  p += nread;
 
-  p += nnum_blks;
-
-  /* First ACK Block */
-  n = ngtcp2_get_varint_len(p);
-  len += n - 1;
-
-  if (payloadlen < len) {
-    return NGTCP2_ERR_FRAME_ENCODING;
+  for (i = 0; i < max_num_blks; ++i) {
+    blk = &dest->blks[i];
+    blk->gap = blks[i * 2];
+    blk->blklen = blks[i * 2 + 1];
   }
 
-  p += n;
-
-  for (i = 0; i < num_blks; ++i) {
-    /* Gap, and Additional ACK Block */
-    for (j = 0; j < 2; ++j) {
-      n = ngtcp2_get_varint_len(p);
-      len += n - 1;
+  /* The remaining ranges are rare, and they are only delimited here.
+     ngtcp2_ack_range_it decodes them from rangebuf. */
+  dest->rangebuf = p;
 
-      if (payloadlen < len) {
-        return NGTCP2_ERR_FRAME_ENCODING;
-      }
-
-      p += n;
-    }
-  }
-
-  if (type == NGTCP2_FRAME_ACK_ECN) {
-    len += 3;
-    if (payloadlen < len) {
+  for (i = max_num_blks * 2; i < num_blks * 2; ++i) {
+    if (p == end) {
       return NGTCP2_ERR_FRAME_ENCODING;
     }
 
-    for (i = 0; i < 3; ++i) {
-      n = ngtcp2_get_varint_len(p);
-      len += n - 1;
-
-      if (payloadlen < len) {
-        return NGTCP2_ERR_FRAME_ENCODING;
-      }
-
-      p += n;
+    n = ngtcp2_get_varint_len(p);
+    if ((size_t)(end - p) < n) {
+      return NGTCP2_ERR_FRAME_ENCODING;
     }
-  }
-
-  /* TODO We might not decode all blocks.  It could be very large. */
-  max_num_blks = ngtcp2_min(NGTCP2_MAX_ACK_BLKS, num_blks);
-
-  p = payload + 1;
-
-  dest->type = type;
-  dest->largest_ack = (int64_t)ngtcp2_get_varint(&n, p);
-  p += n;
-  dest->ack_delay = ngtcp2_get_varint(&n, p);
-  /* This value will be assigned in the upper layer. */
-  dest->ack_delay_unscaled = 0;
-  p += n;
-  dest->num_blks = max_num_blks;
-  p += nnum_blks;
-  dest->first_ack_blklen = ngtcp2_get_varint(&n, p);
-  p += n;
 
-  for (i = 0; i < max_num_blks; ++i) {
-    blk = &dest->blks[i];
-    blk->gap = ngtcp2_get_varint(&n, p);
     p += n;
-    blk->blklen = ngtcp2_get_varint(&n, p);
-    p += n;
-  }
-  for (i = max_num_blks; i < num_blks; ++i) {
-    p += ngtcp2_get_varint_len(p);
-    p += ngtcp2_get_varint_len(p);
   }
 
   if (type == NGTCP2_FRAME_ACK_ECN) {
-    dest->ecn.ect0 = ngtcp2_get_varint(&n, p);
-    p += n;
+    nread = ngtcp2_get_varints(v, 3, p, (size_t)(end - p));
+    if (nread < 0) {
+      return NGTCP2_ERR_FRAME_ENCODING;
+    }
 
-    dest->ecn.ect1 = ngtcp2_get_varint(&n, p);
-    p += n;
+    p += nread;
 
-    dest->ecn.ce = ngtcp2_get_varint(&n, p);
-    p += n;
+    dest->ecn.ect0 = v[0];
+    dest->ecn.ect1 = v[1];
+    dest->ecn.ce = v[2];
   }
 
-  assert((size_t)(p - payload) == len);
-
-  return (ngtcp2_ssize)len;
+  return (ngtcp2_ssize)(p - payload);
 }
 
 size_t ngtcp2_pkt_decode_padding_frame(ngtcp2_padding *dest,
@@ -1428,6 +1402,121 @@ ngtcp2_ssize ngtcp2_pkt_decode_handshake_done_frame(ngtcp2_handshake_done *dest,
   return 1;
 }
 
+ngtcp2_ssize ngtcp2_pkt_decode_ack_frequency_frame(ngtcp2_ack_frequency *dest,
+                                                   const uint8_t *payload,
+                                                   size_t payloadlen) {
+  size_t len = 2 + 1 + 1 + 1 + 1;
+  const uint8_t *p;
+  size_t n;
+  size_t i;
+
+  if (payloadlen < len) {
+    return NGTCP2_ERR_FRAME_ENCODING;
+  }
+
+  p = payload + 2;
+
+  for (i = 0; i < 4; ++i) {
+    n = ngtcp2_get_varint_len(p);
+    len += n - 1;
+
+    if (payloadlen < len) {
+      return NGTCP2_ERR_FRAME_ENCODING;
+    }
+
+    p += n;
+  }
+
+  p = payload + 2;
+
+  dest->type = NGTCP2_FRAME_ACK_FREQUENCY;
+  dest->seq = ngtcp2_get_varint(&n, p);
+  p += n;
+  dest->ack_eliciting_threshold = ngtcp2_get_varint(&n, p);
+  p += n;
+  dest->request_max_ack_delay = ngtcp2_get_varint(&n, p);
+  p += n;
+  dest->reordering_threshold = ngtcp2_get_varint(&n, p);
+  p += n;
+
+  assert((size_t)(p - payload) == len);
+
+  return (ngtcp2_ssize)len;
+}
+
+ngtcp2_ssize ngtcp2_pkt_decode_immediate_ack_frame(ngtcp2_immediate_ack *dest,
+                                                   const uint8_t *payload,
+                                                   size_t payloadlen) {
+  (void)payload;
+  (void)payloadlen;
+
+  dest->type = NGTCP2_FRAME_IMMEDIATE_ACK;
+  return 1;
+}
+
+ngtcp2_ssize ngtcp2_pkt_decode_repair_frame(ngtcp2_repair *dest,
+                                            const uint8_t *payload,
+                                            size_t payloadlen) {
+  const uint8_t *p, *end;
+  ngtcp2_ssize nread;
+  /* v holds Stream ID, Offset, Symbol Count, and then Symbol
+     Lengths. */
+  uint64_t v[3 + NGTCP2_MAX_FEC_SYMBOLCNT];
+  size_t symbolcnt, repairlen = 0;
+  size_t i;
+
+  if (payloadlen < 2) {
+    return NGTCP2_ERR_FRAME_ENCODING;
+  }
+
+  p = payload + 2;
+  end = payload + payloadlen;
+
+  nread = ngtcp2_get_varints(v, 3, p, (size_t)(end - p));
+  if (nread < 0) {
+    return NGTCP2_ERR_FRAME_ENCODING;
+  }
+
+  p += nread;
+
+  if (v[2] == 0 || v[2] > NGTCP2_MAX_FEC_SYMBOLCNT) {
+    return NGTCP2_ERR_FRAME_ENCODING;
+  }
+
+  symbolcnt = (size_t)v[2];
+
+  nread = ngtcp2_get_varints(v + 3, symbolcnt, p, (size_t)(end - p));
+  if (nread < 0) {
+    return NGTCP2_ERR_FRAME_ENCODING;
+  }
+
+  p += nread;
+
+  for (i = 0; i < symbolcnt; ++i) {
+    if (v[3 + i] == 0 || v[3 + i] > NGTCP2_MAX_FEC_SYMBOLLEN) {
+      return NGTCP2_ERR_FRAME_ENCODING;
+    }
+
+    dest->symbollen[i] = (uint16_t)v[3 + i];
+    repairlen = ngtcp2_max(repairlen, dest->symbollen[i]);
+  }
+
+  if ((size_t)(end - p) < repairlen) {
+    return NGTCP2_ERR_FRAME_ENCODING;
+  }
+
+  dest->type = NGTCP2_FRAME_REPAIR;
+  dest->stream_id = (int64_t)v[0];
+  dest->offset = v[1];
+  dest->symbolcnt = symbolcnt;
+  dest->data.base = (uint8_t *)p;
+  dest->data.len = repairlen;
+
+  p += repairlen;
+
+  return (ngtcp2_ssize)(p - payload);
+}
+
 ngtcp2_ssize ngtcp2_pkt_decode_datagram_frame(ngtcp2_datagram *dest,
                                               const uint8_t *payload,
                                               size_t payloadlen) {
@@ -1563,13 +1652,21 @@ ngtcp2_ssize ngtcp2_pkt_encode_frame(uint8_t *out, size_t outlen,
   case NGTCP2_FRAME_DATAGRAM:
   case NGTCP2_FRAME_DATAGRAM_LEN:
     return ngtcp2_pkt_encode_datagram_frame(out, outlen, &fr->datagram);
+  case NGTCP2_FRAME_ACK_FREQUENCY:
+    return ngtcp2_pkt_encode_ack_frequency_frame(out, outlen,
+                                                 &fr->ack_frequency);
+  case NGTCP2_FRAME_IMMEDIATE_ACK:
+    return ngtcp2_pkt_encode_immediate_ack_frame(out, outlen,
+                                                 &fr->immediate_ack);
+  case NGTCP2_FRAME_REPAIR:
+    return ngtcp2_pkt_encode_repair_frame(out, outlen, &fr->repair);
   default:
     return NGTCP2_ERR_INVALID_ARGUMENT;
   }
 }
 
-ngtcp2_ssize ngtcp2_pkt_encode_stream_frame(uint8_t *out, size_t outlen,
-                                            ngtcp2_stream *fr) {
+ngtcp2_ssize ngtcp2_pkt_encode_stream_frame_hd(uint8_t *out, size_t outlen,
+                                               ngtcp2_stream *fr) {
   size_t len = 1;
   uint8_t flags = NGTCP2_STREAM_LEN_BIT;
   uint8_t *p;
@@ -1592,9 +1689,8 @@ ngtcp2_ssize ngtcp2_pkt_encode_stream_frame(uint8_t *out, size_t outlen,
   }
 
   len += ngtcp2_put_varint_len(datalen);
-  len += datalen;
 
-  if (outlen < len) {
+  if (outlen < len + datalen) {
     return NGTCP2_ERR_NOBUF;
   }
 
@@ -1612,15 +1708,31 @@ ngtcp2_ssize ngtcp2_pkt_encode_stream_frame(uint8_t *out, size_t outlen,
 
   p = ngtcp2_put_varint(p, datalen);
 
+  assert((size_t)(p - out) == len);
+
+  return (ngtcp2_ssize)len;
+}
+
+ngtcp2_ssize ngtcp2_pkt_encode_stream_frame(uint8_t *out, size_t outlen,
+                                            ngtcp2_stream *fr) {
+  ngtcp2_ssize nwrite;
+  uint8_t *p;
+  size_t i;
+
+  nwrite = ngtcp2_pkt_encode_stream_frame_hd(out, outlen, fr);
+  if (nwrite < 0) {
+    return nwrite;
+  }
+
+  p = out + nwrite;
+
   for (i = 0; i < fr->datacnt; ++i) {
     assert(fr->data[i].len);
     assert(fr->data[i].base);
     p = ngtcp2_cpymem(p, fr->data[i].base, fr->data[i].len);
   }
 
-  assert((size_t)(p - out) == len);
-
-  return (ngtcp2_ssize)len;
+  return p - out;
 }
 
 ngtcp2_ssize ngtcp2_pkt_encode_ack_frame(uint8_t *out, size_t outlen,
@@ -2057,6 +2169,83 @@ ngtcp2_pkt_encode_handshake_done_frame(uint8_t *out, size_t outlen,
   return 1;
 }
 
+ngtcp2_ssize
+ngtcp2_pkt_encode_ack_frequency_frame(uint8_t *out, size_t outlen,
+                                      const ngtcp2_ack_frequency *fr) {
+  size_t len = 2 + ngtcp2_put_varint_len(fr->seq) +
+               ngtcp2_put_varint_len(fr->ack_eliciting_threshold) +
+               ngtcp2_put_varint_len(fr->request_max_ack_delay) +
+               ngtcp2_put_varint_len(fr->reordering_threshold);
+  uint8_t *p;
+
+  if (outlen < len) {
+    return NGTCP2_ERR_NOBUF;
+  }
+
+  p = out;
+
+  p = ngtcp2_put_varint(p, NGTCP2_FRAME_ACK_FREQUENCY);
+  p = ngtcp2_put_varint(p, fr->seq);
+  p = ngtcp2_put_varint(p, fr->ack_eliciting_threshold);
+  p = ngtcp2_put_varint(p, fr->request_max_ack_delay);
+  p = ngtcp2_put_varint(p, fr->reordering_threshold);
+
+  assert((size_t)(p - out) == len);
+
+  return (ngtcp2_ssize)len;
+}
+
+ngtcp2_ssize
+ngtcp2_pkt_encode_immediate_ack_frame(uint8_t *out, size_t outlen,
+                                      const ngtcp2_immediate_ack *fr) {
+  (void)fr;
+
+  if (outlen < 1) {
+    return NGTCP2_ERR_NOBUF;
+  }
+
+  *out++ = NGTCP2_FRAME_IMMEDIATE_ACK;
+
+  return 1;
+}
+
+ngtcp2_ssize ngtcp2_pkt_encode_repair_frame(uint8_t *out, size_t outlen,
+                                            const ngtcp2_repair *fr) {
+  size_t len = 2 + ngtcp2_put_varint_len((uint64_t)fr->stream_id) +
+               ngtcp2_put_varint_len(fr->offset) +
+               ngtcp2_put_varint_len(fr->symbolcnt) + fr->data.len;
+  uint8_t *p;
+  size_t i;
+
+  assert(fr->symbolcnt);
+  assert(fr->symbolcnt <= NGTCP2_MAX_FEC_SYMBOLCNT);
+
+  for (i = 0; i < fr->symbolcnt; ++i) {
+    len += ngtcp2_put_varint_len(fr->symbollen[i]);
+  }
+
+  if (outlen < len) {
+    return NGTCP2_ERR_NOBUF;
+  }
+
+  p = out;
+
+  p = ngtcp2_put_varint(p, NGTCP2_FRAME_REPAIR);
+  p = ngtcp2_put_varint(p, (uint64_t)fr->stream_id);
+  p = ngtcp2_put_varint(p, fr->offset);
+  p = ngtcp2_put_varint(p, fr->symbolcnt);
+
+  for (i = 0; i < fr->symbolcnt; ++i) {
+    p = ngtcp2_put_varint(p, fr->symbollen[i]);
+  }
+
+  p = ngtcp2_cpymem(p, fr->data.base, fr->data.len);
+
+  assert((size_t)(p - out) == len);
+
+  return (ngtcp2_ssize)len;
+}
+
 ngtcp2_ssize ngtcp2_pkt_encode_datagram_frame(uint8_t *out, size_t outlen,
                                               const ngtcp2_datagram *fr) {
   uint64_t datalen = ngtcp2_vec_len(fr->data, fr->datacnt);
@@ -2194,9 +2383,32 @@ int64_t ngtcp2_pkt_adjust_pkt_num(int64_t max_pkt_num, int64_t pkt_num,
   return cand;
 }
 
+void ngtcp2_ack_range_it_init(ngtcp2_ack_range_it *it, const ngtcp2_ack *fr) {
+  it->fr = fr;
+  it->p = fr->num_blks > NGTCP2_MAX_ACK_BLKS ? fr->rangebuf : NULL;
+  it->i = 0;
+}
+
+void ngtcp2_ack_range_it_next_rangebuf(ngtcp2_ack_range_it *it,
+                                       ngtcp2_ack_blk *blk) {
+  size_t n;
+
+  assert(it->p);
+
+  ++it->i;
+
+  /* ngtcp2_pkt_decode_ack_frame has verified that the ranges are in
+     the payload. */
+  blk->gap = ngtcp2_get_varint(&n, it->p);
+  it->p += n;
+  blk->blklen = ngtcp2_get_varint(&n, it->p);
+  it->p += n;
+}
+
 int ngtcp2_pkt_validate_ack(ngtcp2_ack *fr) {
   int64_t largest_ack = fr->largest_ack;
-  size_t i;
+  ngtcp2_ack_range_it it;
+  ngtcp2_ack_blk blk;
 
   if (largest_ack < (int64_t)fr->first_ack_blklen) {
     return NGTCP2_ERR_ACK_FRAME;
@@ -2204,18 +2416,20 @@ int ngtcp2_pkt_validate_ack(ngtcp2_ack *fr) {
 
   largest_ack -= (int64_t)fr->first_ack_blklen;
 
-  for (i = 0; i < fr->num_blks; ++i) {
-    if (largest_ack < (int64_t)fr->blks[i].gap + 2) {
+  ngtcp2_ack_range_it_init(&it, fr);
+
+  while (ngtcp2_ack_range_it_next(&it, &blk)) {
+    if (largest_ack < (int64_t)blk.gap + 2) {
       return NGTCP2_ERR_ACK_FRAME;
     }
 
-    largest_ack -= (int64_t)fr->blks[i].gap + 2;
+    largest_ack -= (int64_t)blk.gap + 2;
 
-    if (largest_ack < (int64_t)fr->blks[i].blklen) {
+    if (largest_ack < (int64_t)blk.blklen) {
       return NGTCP2_ERR_ACK_FRAME;
     }
 
-    largest_ack -= (int64_t)fr->blks[i].blklen;
+    largest_ack -= (int64_t)blk.blklen;
   }
 
   return 0;
@@ -168,8 +168,16 @@ typedef enum {
   NGTCP2_FRAME_CONNECTION_CLOSE = 0x1c,
   NGTCP2_FRAME_CONNECTION_CLOSE_APP = 0x1d,
   NGTCP2_FRAME_HANDSHAKE_DONE = 0x1e,
+  NGTCP2_FRAME_IMMEDIATE_ACK = 0x1f,
   NGTCP2_FRAME_DATAGRAM = 0x30,
   NGTCP2_FRAME_DATAGRAM_LEN = 0x31,
+  /* NGTCP2_FRAME_ACK_FREQUENCY is encoded in 2 bytes varint on the
+     wire. */
+  NGTCP2_FRAME_ACK_FREQUENCY = 0xaf,
+  /* NGTCP2_FRAME_REPAIR is the frame of the experimental forward
+     error correction extension.  It is encoded in 2 bytes varint on
+     the wire.  The codepoint is not registered. */
+  NGTCP2_FRAME_REPAIR = 0xec,
 } ngtcp2_frame_type;
 
 typedef struct ngtcp2_stream {
@@ -197,6 +205,10 @@ typedef struct ngtcp2_ack_blk {
 
 typedef struct ngtcp2_ack {
   uint8_t type;
+  /* num_blks is the number of the additional ACK Ranges.  It may
+     exceed NGTCP2_MAX_ACK_BLKS if the frame is received.  It is
+     32 bits long so that it fits in the padding after type. */
+  uint32_t num_blks;
   int64_t largest_ack;
   uint64_t ack_delay;
   /**
@@ -210,10 +222,30 @@ typedef struct ngtcp2_ack {
     uint64_t ce;
   } ecn;
   uint64_t first_ack_blklen;
-  size_t num_blks;
+  /* rangebuf points to the encoded ACK Ranges which follow the first
+     NGTCP2_MAX_ACK_BLKS ranges in the payload of a received ACK
+     frame.  It is only used if num_blks > NGTCP2_MAX_ACK_BLKS, and
+     those ranges are decoded by ngtcp2_ack_range_it on demand. */
+  const uint8_t *rangebuf;
+  /* blks contains the first min(num_blks, NGTCP2_MAX_ACK_BLKS)
+     additional ACK Ranges.  Although the length of blks is 1 in this
+     definition, the library may allocate extra bytes to hold more
+     elements. */
   ngtcp2_ack_blk blks[1];
 } ngtcp2_ack;
 
+/*
+ * ngtcp2_ack_range_it iterates over all additional ACK Ranges of
+ * ngtcp2_ack, including the ones which do not fit in blks.
+ */
+typedef struct ngtcp2_ack_range_it {
+  const ngtcp2_ack *fr;
+  /* p points to the next encoded range in fr->rangebuf after the
+     ranges in fr->blks are exhausted. */
+  const uint8_t *p;
+  size_t i;
+} ngtcp2_ack_range_it;
+
 typedef struct ngtcp2_padding {
   uint8_t type;
   /**
@@ -340,6 +372,45 @@ typedef struct ngtcp2_datagram {
   ngtcp2_vec rdata[1];
 } ngtcp2_datagram;
 
+typedef struct ngtcp2_ack_frequency {
+  uint8_t type;
+  uint64_t seq;
+  /* ack_eliciting_threshold is the maximum number of ack-eliciting
+     packets that the receiver can leave unacknowledged. */
+  uint64_t ack_eliciting_threshold;
+  /* request_max_ack_delay is the max_ack_delay that the sender
+     requests, in microseconds as it is on the wire. */
+  uint64_t request_max_ack_delay;
+  /* reordering_threshold is the number of reordered packets which
+     triggers an immediate acknowledgement.  0 means that reordering
+     never triggers it. */
+  uint64_t reordering_threshold;
+} ngtcp2_ack_frequency;
+
+typedef struct ngtcp2_immediate_ack {
+  uint8_t type;
+} ngtcp2_immediate_ack;
+
+/* NGTCP2_MAX_FEC_SYMBOLLEN is the maximum length of STREAM data that
+   REPAIR frame protects per STREAM frame. */
+#define NGTCP2_MAX_FEC_SYMBOLLEN 1500
+
+typedef struct ngtcp2_repair {
+  uint8_t type;
+  int64_t stream_id;
+  /* offset is the stream offset of the first protected STREAM
+     frame.  The protected STREAM frames are contiguous. */
+  uint64_t offset;
+  /* symbolcnt is the number of the protected STREAM frames. */
+  size_t symbolcnt;
+  /* symbollen contains the data length of each protected STREAM
+     frame. */
+  uint16_t symbollen[NGTCP2_MAX_FEC_SYMBOLCNT];
+  /* data is XOR of the data of the protected STREAM frames, each of
+     which is padded with zeros to the longest one. */
+  ngtcp2_vec data;
+} ngtcp2_repair;
+
 typedef union ngtcp2_frame {
   uint8_t type;
   ngtcp2_stream stream;
@@ -363,6 +434,9 @@ typedef union ngtcp2_frame {
   ngtcp2_retire_connection_id retire_connection_id;
   ngtcp2_handshake_done handshake_done;
   ngtcp2_datagram datagram;
+  ngtcp2_ack_frequency ack_frequency;
+  ngtcp2_immediate_ack immediate_ack;
+  ngtcp2_repair repair;
 } ngtcp2_frame;
 
 typedef struct ngtcp2_pkt_chain ngtcp2_pkt_chain;
@@ -384,28 +458,26 @@ struct ngtcp2_pkt_chain {
 };
 
 /*
- * ngtcp2_pkt_chain_new allocates ngtcp2_pkt_chain objects, and
- * assigns its pointer to |*ppc|.  The content of buffer pointed by
- * |pkt| of length |pktlen| is copied into |*ppc|.  The packet is
- * obtained via the network |path|.  The values of path->local and
- * path->remote are copied into |*ppc|.
- *
- * This function returns 0 if it succeeds, or one of the following
- * negative error codes:
- *
- * NGTCP2_ERR_NOMEM
- *     Out of memory.
+ * ngtcp2_pkt_chain_objlen returns the number of bytes that
+ * ngtcp2_pkt_chain which holds a packet of length |pktlen| occupies.
+ * It is a multiple of 8, so that the objects can be laid out back to
+ * back in a buffer.
  */
-int ngtcp2_pkt_chain_new(ngtcp2_pkt_chain **ppc, const ngtcp2_path *path,
-                         const ngtcp2_pkt_info *pi, const uint8_t *pkt,
-                         size_t pktlen, size_t dgramlen, ngtcp2_tstamp ts,
-                         const ngtcp2_mem *mem);
+size_t ngtcp2_pkt_chain_objlen(size_t pktlen);
 
 /*
- * ngtcp2_pkt_chain_del deallocates |pc|.  It also frees the memory
- * pointed by |pc|.
- */
-void ngtcp2_pkt_chain_del(ngtcp2_pkt_chain *pc, const ngtcp2_mem *mem);
+ * ngtcp2_pkt_chain_init initializes ngtcp2_pkt_chain object placed
+ * at |p|, and returns it.  |p| must have
+ * ngtcp2_pkt_chain_objlen(|pktlen|) bytes, aligned to 8 bytes.  The
+ * content of buffer pointed by |pkt| of length |pktlen| is copied
+ * after the object.  The packet is obtained via the network |path|.
+ * The values of path->local and path->remote are copied into the
+ * object.
+ */
+ngtcp2_pkt_chain *ngtcp2_pkt_chain_init(uint8_t *p, const ngtcp2_path *path,
+                                        const ngtcp2_pkt_info *pi,
+                                        const uint8_t *pkt, size_t pktlen,
+                                        size_t dgramlen, ngtcp2_tstamp ts);
 
 /*
  * ngtcp2_pkt_hd_init initializes |hd| with the given values.  If
@@ -540,6 +612,10 @@ ngtcp2_ssize ngtcp2_pkt_decode_stream_frame(ngtcp2_stream *dest,
  *
  * NGTCP2_ERR_FRAME_ENCODING
  *     Payload is too short to include ACK frame.
+ *
+ * The ACK Ranges beyond NGTCP2_MAX_ACK_BLKS are not copied.
+ * dest->rangebuf points to them in |payload|, which must outlive
+ * |dest|.  Use ngtcp2_ack_range_it to read all ranges.
  */
 ngtcp2_ssize ngtcp2_pkt_decode_ack_frame(ngtcp2_ack *dest,
                                          const uint8_t *payload,
@@ -839,6 +915,50 @@ ngtcp2_ssize ngtcp2_pkt_decode_datagram_frame(ngtcp2_datagram *dest,
                                               const uint8_t *payload,
                                               size_t payloadlen);
 
+/*
+ * ngtcp2_pkt_decode_ack_frequency_frame decodes ACK_FREQUENCY frame
+ * from |payload| of length |payloadlen|.  The result is stored in the
+ * object pointed by |dest|.  ACK_FREQUENCY frame must start at
+ * payload[0].  This function finishes when it decodes one
+ * ACK_FREQUENCY frame, and returns the exact number of bytes read to
+ * decode a frame if it succeeds, or one of the following negative
+ * error codes:
+ *
+ * NGTCP2_ERR_FRAME_ENCODING
+ *     Payload is too short to include ACK_FREQUENCY frame.
+ */
+ngtcp2_ssize ngtcp2_pkt_decode_ack_frequency_frame(ngtcp2_ack_frequency *dest,
+                                                   const uint8_t *payload,
+                                                   size_t payloadlen);
+
+/*
+ * ngtcp2_pkt_decode_immediate_ack_frame decodes IMMEDIATE_ACK frame
+ * from |payload| of length |payloadlen|.  The result is stored in the
+ * object pointed by |dest|.  IMMEDIATE_ACK frame must start at
+ * payload[0].  This function finishes when it decodes one
+ * IMMEDIATE_ACK frame, and returns the exact number of bytes read to
+ * decode a frame.
+ */
+ngtcp2_ssize ngtcp2_pkt_decode_immediate_ack_frame(ngtcp2_immediate_ack *dest,
+                                                   const uint8_t *payload,
+                                                   size_t payloadlen);
+
+/*
+ * ngtcp2_pkt_decode_repair_frame decodes REPAIR frame from |payload|
+ * of length |payloadlen|.  The result is stored in the object pointed
+ * by |dest|.  REPAIR frame must start at payload[0].  This function
+ * finishes when it decodes one REPAIR frame, and returns the exact
+ * number of bytes read to decode a frame if it succeeds, or one of
+ * the following negative error codes:
+ *
+ * NGTCP2_ERR_FRAME_ENCODING
+ *     Payload is too short to include REPAIR frame, or the number of
+ *     symbols or the length of a symbol is out of range.
+ */
+ngtcp2_ssize ngtcp2_pkt_decode_repair_frame(ngtcp2_repair *dest,
+                                            const uint8_t *payload,
+                                            size_t payloadlen);
+
 /*
  * ngtcp2_pkt_encode_stream_frame encodes STREAM frame |fr| into the
  * buffer pointed by |out| of length |outlen|.
@@ -855,6 +975,21 @@ ngtcp2_ssize ngtcp2_pkt_decode_datagram_frame(ngtcp2_datagram *dest,
 ngtcp2_ssize ngtcp2_pkt_encode_stream_frame(uint8_t *out, size_t outlen,
                                             ngtcp2_stream *fr);
 
+/*
+ * ngtcp2_pkt_encode_stream_frame_hd is similar to
+ * ngtcp2_pkt_encode_stream_frame, but it only writes the fields
+ * preceding stream data.  |outlen| must be large enough to store the
+ * whole frame including stream data.
+ *
+ * This function returns the number of bytes written if it succeeds,
+ * or one of the following negative error codes:
+ *
+ * NGTCP2_ERR_NOBUF
+ *     Buffer does not have enough capacity to write a frame.
+ */
+ngtcp2_ssize ngtcp2_pkt_encode_stream_frame_hd(uint8_t *out, size_t outlen,
+                                               ngtcp2_stream *fr);
+
 /*
  * ngtcp2_pkt_encode_ack_frame encodes ACK frame |fr| into the buffer
  * pointed by |out| of length |outlen|.
@@ -1131,6 +1266,47 @@ ngtcp2_pkt_encode_handshake_done_frame(uint8_t *out, size_t outlen,
 ngtcp2_ssize ngtcp2_pkt_encode_datagram_frame(uint8_t *out, size_t outlen,
                                               const ngtcp2_datagram *fr);
 
+/*
+ * ngtcp2_pkt_encode_ack_frequency_frame encodes ACK_FREQUENCY frame
+ * |fr| into the buffer pointed by |out| of length |outlen|.
+ *
+ * This function returns the number of bytes written if it succeeds,
+ * or one of the following negative error codes:
+ *
+ * NGTCP2_ERR_NOBUF
+ *     Buffer does not have enough capacity to write a frame.
+ */
+ngtcp2_ssize
+ngtcp2_pkt_encode_ack_frequency_frame(uint8_t *out, size_t outlen,
+                                      const ngtcp2_ack_frequency *fr);
+
+/*
+ * ngtcp2_pkt_encode_immediate_ack_frame encodes IMMEDIATE_ACK frame
+ * |fr| into the buffer pointed by |out| of length |outlen|.
+ *
+ * This function returns the number of bytes written if it succeeds,
+ * or one of the following negative error codes:
+ *
+ * NGTCP2_ERR_NOBUF
+ *     Buffer does not have enough capacity to write a frame.
+ */
+ngtcp2_ssize
+ngtcp2_pkt_encode_immediate_ack_frame(uint8_t *out, size_t outlen,
+                                      const ngtcp2_immediate_ack *fr);
+
+/*
+ * ngtcp2_pkt_encode_repair_frame encodes REPAIR frame |fr| into the
+ * buffer pointed by |out| of length |outlen|.
+ *
+ * This function returns the number of bytes written if it succeeds,
+ * or one of the following negative error codes:
+ *
+ * NGTCP2_ERR_NOBUF
+ *     Buffer does not have enough capacity to write a frame.
+ */
+ngtcp2_ssize ngtcp2_pkt_encode_repair_frame(uint8_t *out, size_t outlen,
+                                            const ngtcp2_repair *fr);
+
 /*
  * ngtcp2_pkt_adjust_pkt_num find the full 64 bits packet number for
  * |pkt_num|, which is expected to be least significant |n| bits.  The
@@ -1140,6 +1316,41 @@ ngtcp2_ssize ngtcp2_pkt_encode_datagram_frame(uint8_t *out, size_t outlen,
 int64_t ngtcp2_pkt_adjust_pkt_num(int64_t max_pkt_num, int64_t pkt_num,
                                   size_t n);
 
+/*
+ * ngtcp2_ack_range_it_init initializes |it| to iterate over the
+ * additional ACK Ranges of |fr|.
+ */
+void ngtcp2_ack_range_it_init(ngtcp2_ack_range_it *it, const ngtcp2_ack *fr);
+
+/*
+ * ngtcp2_ack_range_it_next_rangebuf decodes the next ACK Range from
+ * it->fr->rangebuf, and stores it in |*blk|.
+ */
+void ngtcp2_ack_range_it_next_rangebuf(ngtcp2_ack_range_it *it,
+                                       ngtcp2_ack_blk *blk);
+
+/*
+ * ngtcp2_ack_range_it_next stores the next ACK Range in |*blk|, and
+ * returns nonzero.  It returns 0 if there is no more range.  It is
+ * inlined because it is called for each range in the hot path of
+ * ACK processing.
+ */
+static inline int ngtcp2_ack_range_it_next(ngtcp2_ack_range_it *it,
+                                           ngtcp2_ack_blk *blk) {
+  if (it->i == it->fr->num_blks) {
+    return 0;
+  }
+
+  if (it->i < NGTCP2_MAX_ACK_BLKS) {
+    *blk = it->fr->blks[it->i++];
+    return 1;
+  }
+
+  ngtcp2_ack_range_it_next_rangebuf(it, blk);
+
+  return 1;
+}
+
 /*
  * ngtcp2_pkt_validate_ack checks that ack is malformed or not.
  *
@@ -43,9 +43,33 @@ static size_t mtu_probes[] = {
 
 static size_t mtu_probeslen = sizeof(mtu_probes) / sizeof(mtu_probes[0]);
 
+/* NGTCP2_PMTUD_SEARCH_MAX_UDP_PAYLOAD_SIZE is the largest UDP payload
+   size that binary search probes.  It is the largest UDP payload over
+   IPv6 without jumbograms. */
+#define NGTCP2_PMTUD_SEARCH_MAX_UDP_PAYLOAD_SIZE 65527
+
+/* NGTCP2_PMTUD_SEARCH_GRANULARITY is the precision of binary search.
+   The search finishes when the range between the largest UDP payload
+   size that works and the smallest one that fails gets narrower than
+   this. */
+#define NGTCP2_PMTUD_SEARCH_GRANULARITY 16
+
+/* search_probes is the UDP payload sizes which are tried in order
+   before binary search starts.  They are likely to match the MTU of
+   a path exactly, which bisection only approximates. */
+static size_t search_probes[] = {
+    1500 - 48, /* Ethernet */
+    9000 - 48, /* Jumbo frame */
+};
+
+static size_t search_probeslen =
+    sizeof(search_probes) / sizeof(search_probes[0]);
+
+static void pmtud_search_next_probe(ngtcp2_pmtud *pmtud);
+
 int ngtcp2_pmtud_new(ngtcp2_pmtud **ppmtud, size_t max_udp_payload_size,
                      size_t hard_max_udp_payload_size, int64_t tx_pkt_num,
-                     const ngtcp2_mem *mem) {
+                     uint32_t flags, const ngtcp2_mem *mem) {
   ngtcp2_pmtud *pmtud = ngtcp2_mem_malloc(mem, sizeof(ngtcp2_pmtud));
 
   if (pmtud == NULL) {
@@ -53,6 +77,7 @@ int ngtcp2_pmtud_new(ngtcp2_pmtud **ppmtud, size_t max_udp_payload_size,
   }
 
   pmtud->mem = mem;
+  pmtud->flags = flags;
   pmtud->mtu_idx = 0;
   pmtud->num_pkts_sent = 0;
   pmtud->expiry = UINT64_MAX;
@@ -60,6 +85,19 @@ int ngtcp2_pmtud_new(ngtcp2_pmtud **ppmtud, size_t max_udp_payload_size,
   pmtud->max_udp_payload_size = max_udp_payload_size;
   pmtud->hard_max_udp_payload_size = hard_max_udp_payload_size;
   pmtud->min_fail_udp_payload_size = SIZE_MAX;
+  pmtud->probelen = 0;
+
+  if (flags & NGTCP2_PMTUD_FLAG_SEARCH) {
+    pmtud->hard_max_udp_payload_size =
+        ngtcp2_min(hard_max_udp_payload_size,
+                   NGTCP2_PMTUD_SEARCH_MAX_UDP_PAYLOAD_SIZE);
+
+    pmtud_search_next_probe(pmtud);
+
+    *ppmtud = pmtud;
+
+    return 0;
+  }
 
   for (; pmtud->mtu_idx < mtu_probeslen; ++pmtud->mtu_idx) {
     if (mtu_probes[pmtud->mtu_idx] > pmtud->hard_max_udp_payload_size) {
@@ -84,6 +122,12 @@ void ngtcp2_pmtud_del(ngtcp2_pmtud *pmtud) {
 }
 
 size_t ngtcp2_pmtud_probelen(ngtcp2_pmtud *pmtud) {
+  if (pmtud->flags & NGTCP2_PMTUD_FLAG_SEARCH) {
+    assert(pmtud->probelen);
+
+    return pmtud->probelen;
+  }
+
   assert(pmtud->mtu_idx < mtu_probeslen);
 
   return mtu_probes[pmtud->mtu_idx];
@@ -125,10 +169,49 @@ static void pmtud_next_probe(ngtcp2_pmtud *pmtud) {
   }
 }
 
+static void pmtud_search_next_probe(ngtcp2_pmtud *pmtud) {
+  size_t lo = pmtud->max_udp_payload_size;
+  size_t hi = pmtud->hard_max_udp_payload_size;
+  size_t i;
+
+  pmtud->num_pkts_sent = 0;
+  pmtud->expiry = UINT64_MAX;
+
+  if (pmtud->min_fail_udp_payload_size <= hi) {
+    hi = pmtud->min_fail_udp_payload_size - 1;
+  }
+
+  for (i = 0; i < search_probeslen; ++i) {
+    if (lo < search_probes[i] && search_probes[i] <= hi) {
+      pmtud->probelen = search_probes[i];
+      return;
+    }
+  }
+
+  if (hi <= lo || hi - lo < NGTCP2_PMTUD_SEARCH_GRANULARITY) {
+    pmtud->probelen = 0;
+    return;
+  }
+
+  pmtud->probelen = lo + (hi - lo + 1) / 2;
+}
+
 void ngtcp2_pmtud_probe_success(ngtcp2_pmtud *pmtud, size_t payloadlen) {
   pmtud->max_udp_payload_size =
       ngtcp2_max(pmtud->max_udp_payload_size, payloadlen);
 
+  if (pmtud->flags & NGTCP2_PMTUD_FLAG_SEARCH) {
+    assert(pmtud->probelen);
+
+    if (pmtud->probelen > pmtud->max_udp_payload_size) {
+      return;
+    }
+
+    pmtud_search_next_probe(pmtud);
+
+    return;
+  }
+
   assert(pmtud->mtu_idx < mtu_probeslen);
 
   if (mtu_probes[pmtud->mtu_idx] > pmtud->max_udp_payload_size) {
@@ -149,12 +232,21 @@ void ngtcp2_pmtud_handle_expiry(ngtcp2_pmtud *pmtud, ngtcp2_tstamp ts) {
     return;
   }
 
-  pmtud->min_fail_udp_payload_size =
-      ngtcp2_min(pmtud->min_fail_udp_payload_size, mtu_probes[pmtud->mtu_idx]);
+  pmtud->min_fail_udp_payload_size = ngtcp2_min(
+      pmtud->min_fail_udp_payload_size, ngtcp2_pmtud_probelen(pmtud));
+
+  if (pmtud->flags & NGTCP2_PMTUD_FLAG_SEARCH) {
+    pmtud_search_next_probe(pmtud);
+    return;
+  }
 
   pmtud_next_probe(pmtud);
 }
 
 int ngtcp2_pmtud_finished(ngtcp2_pmtud *pmtud) {
+  if (pmtud->flags & NGTCP2_PMTUD_FLAG_SEARCH) {
+    return pmtud->probelen == 0;
+  }
+
   return pmtud->mtu_idx >= mtu_probeslen;
 }
@@ -31,8 +31,17 @@
 
 #include <ngtcp2/ngtcp2.h>
 
+/* NGTCP2_PMTUD_FLAG_NONE indicates that no flag is set. */
+#define NGTCP2_PMTUD_FLAG_NONE 0x00u
+/* NGTCP2_PMTUD_FLAG_SEARCH indicates that UDP payload size is found
+   by binary search instead of trying the fixed candidates in
+   order. */
+#define NGTCP2_PMTUD_FLAG_SEARCH 0x01u
+
 typedef struct ngtcp2_pmtud {
   const ngtcp2_mem *mem;
+  /* flags is bitwise OR of zero or more of NGTCP2_PMTUD_FLAG_*. */
+  uint32_t flags;
   /* mtu_idx is the index of UDP payload size candidates to try
      out. */
   size_t mtu_idx;
@@ -58,6 +67,10 @@ typedef struct ngtcp2_pmtud {
   /* min_fail_udp_payload_size is the minimum UDP payload size that is
      known to fail. */
   size_t min_fail_udp_payload_size;
+  /* probelen is the UDP payload size to try out if
+     NGTCP2_PMTUD_FLAG_SEARCH is set.  0 means that the search has
+     finished. */
+  size_t probelen;
 } ngtcp2_pmtud;
 
 /*
@@ -70,6 +83,12 @@ typedef struct ngtcp2_pmtud {
  * larger than or equal to all UDP payload probe candidates.
  * Therefore, call ngtcp2_pmtud_finished to check this situation.
  *
+ * If |flags| includes NGTCP2_PMTUD_FLAG_SEARCH, the well known MTUs
+ * of Ethernet and jumbo frames are tried first, and then UDP payload
+ * size is bisected between the largest size that works and the
+ * smallest size that fails, up to min(|hard_max_udp_payload_size|,
+ * 65527).
+ *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
  *
@@ -78,7 +97,7 @@ typedef struct ngtcp2_pmtud {
  */
 int ngtcp2_pmtud_new(ngtcp2_pmtud **ppmtud, size_t max_udp_payload_size,
                      size_t hard_max_udp_payload_size, int64_t tx_pkt_num,
-                     const ngtcp2_mem *mem);
+                     uint32_t flags, const ngtcp2_mem *mem);
 
 /*
  * ngtcp2_pmtud_del deletes |pmtud|.
@@ -29,6 +29,7 @@
 
 #include "ngtcp2_str.h"
 #include "ngtcp2_conv.h"
+#include "ngtcp2_cid.h"
 
 void ngtcp2_ppe_init(ngtcp2_ppe *ppe, uint8_t *out, size_t outlen,
                      ngtcp2_crypto_cc *cc) {
@@ -41,6 +42,7 @@ void ngtcp2_ppe_init(ngtcp2_ppe *ppe, uint8_t *out, size_t outlen,
   ppe->pkt_num = 0;
   ppe->sample_offset = 0;
   ppe->cc = cc;
+  ppe->extcnt = 0;
 }
 
 int ngtcp2_ppe_encode_hd(ngtcp2_ppe *ppe, const ngtcp2_pkt_hd *hd) {
@@ -81,6 +83,87 @@ int ngtcp2_ppe_encode_hd(ngtcp2_ppe *ppe, const ngtcp2_pkt_hd *hd) {
   return 0;
 }
 
+int ngtcp2_ppe_encode_hd_tmpl(ngtcp2_ppe *ppe, ngtcp2_ppe_hd_tmpl *tmpl,
+                              const ngtcp2_pkt_hd *hd) {
+  ngtcp2_buf *buf = &ppe->buf;
+  ngtcp2_crypto_cc *cc = ppe->cc;
+  uint8_t flags = hd->flags & (NGTCP2_PKT_FLAG_KEY_PHASE |
+                               NGTCP2_PKT_FLAG_FIXED_BIT_CLEAR |
+                               NGTCP2_PKT_FLAG_SPIN_BIT);
+  size_t len;
+  int rv;
+
+  assert(!(hd->flags & NGTCP2_PKT_FLAG_LONG_FORM));
+
+  if (tmpl->len == 0 || tmpl->flags != flags ||
+      tmpl->pkt_numlen != hd->pkt_numlen ||
+      !ngtcp2_cid_eq_inline(&tmpl->dcid, &hd->dcid)) {
+    rv = ngtcp2_ppe_encode_hd(ppe, hd);
+    if (rv != 0) {
+      return rv;
+    }
+
+    tmpl->dcid = hd->dcid;
+    tmpl->len = 1 + hd->dcid.datalen;
+    tmpl->flags = flags;
+    tmpl->pkt_numlen = (uint8_t)hd->pkt_numlen;
+    memcpy(tmpl->data, buf->begin, tmpl->len);
+
+    return 0;
+  }
+
+  len = tmpl->len + hd->pkt_numlen;
+
+  if (ngtcp2_buf_left(buf) < cc->aead.max_overhead + len) {
+    return NGTCP2_ERR_NOBUF;
+  }
+
+  buf->last = ngtcp2_cpymem(buf->last, tmpl->data, tmpl->len);
+  buf->last = ngtcp2_put_pkt_num(buf->last, hd->pkt_num, hd->pkt_numlen);
+
+  ppe->pkt_num_offset = tmpl->len;
+  ppe->sample_offset = ppe->pkt_num_offset + 4;
+  ppe->pkt_numlen = hd->pkt_numlen;
+  ppe->hdlen = len;
+  ppe->pkt_num = hd->pkt_num;
+
+  return 0;
+}
+
+/*
+ * ppe_encode_stream_frame_ext encodes STREAM frame |fr| without
+ * copying its data.  The room for the data is reserved in the buffer,
+ * and the data is recorded in ppe->ext.
+ */
+static int ppe_encode_stream_frame_ext(ngtcp2_ppe *ppe, ngtcp2_stream *fr) {
+  ngtcp2_ssize rv;
+  ngtcp2_buf *buf = &ppe->buf;
+  ngtcp2_crypto_cc *cc = ppe->cc;
+  ngtcp2_ppe_ext *ext;
+  size_t i;
+
+  rv = ngtcp2_pkt_encode_stream_frame_hd(
+      buf->last, ngtcp2_buf_left(buf) - cc->aead.max_overhead, fr);
+  if (rv < 0) {
+    return (int)rv;
+  }
+
+  buf->last += rv;
+
+  for (i = 0; i < fr->datacnt; ++i) {
+    assert(fr->data[i].len);
+    assert(fr->data[i].base);
+
+    ext = &ppe->ext[ppe->extcnt++];
+    ext->offset = ngtcp2_buf_len(buf);
+    ext->data = fr->data[i];
+
+    buf->last += fr->data[i].len;
+  }
+
+  return 0;
+}
+
 int ngtcp2_ppe_encode_frame(ngtcp2_ppe *ppe, ngtcp2_frame *fr) {
   ngtcp2_ssize rv;
   ngtcp2_buf *buf = &ppe->buf;
@@ -90,6 +173,12 @@ int ngtcp2_ppe_encode_frame(ngtcp2_ppe *ppe, ngtcp2_frame *fr) {
     return NGTCP2_ERR_NOBUF;
   }
 
+  if (cc->encrypt_vec && fr->type == NGTCP2_FRAME_STREAM &&
+      fr->stream.datacnt &&
+      ppe->extcnt + fr->stream.datacnt <= NGTCP2_PPE_MAX_EXTCNT) {
+    return ppe_encode_stream_frame_ext(ppe, &fr->stream);
+  }
+
   rv = ngtcp2_pkt_encode_frame(
       buf->last, ngtcp2_buf_left(buf) - cc->aead.max_overhead, fr);
   if (rv < 0) {
@@ -101,14 +190,91 @@ int ngtcp2_ppe_encode_frame(ngtcp2_ppe *ppe, ngtcp2_frame *fr) {
   return 0;
 }
 
+/*
+ * ppe_apply_hp applies header protection |mask| to the packet pointed
+ * by |pkt|.
+ */
+static void ppe_apply_hp(uint8_t *pkt, const uint8_t *mask,
+                         size_t pkt_num_offset, size_t pkt_numlen) {
+  uint8_t *p = pkt;
+  size_t i;
+
+  if (*p & NGTCP2_HEADER_FORM_BIT) {
+    *p = (uint8_t)(*p ^ (mask[0] & 0x0f));
+  } else {
+    *p = (uint8_t)(*p ^ (mask[0] & 0x1f));
+  }
+
+  p = pkt + pkt_num_offset;
+  for (i = 0; i < pkt_numlen; ++i) {
+    *(p + i) ^= mask[i + 1];
+  }
+}
+
+/*
+ * ppe_encrypt_vec encrypts the payload of length |payloadlen| pointed
+ * by |payload| with cc->encrypt_vec.  The payload is split at the
+ * STREAM data in ppe->ext which are passed without copying.
+ */
+static int ppe_encrypt_vec(ngtcp2_ppe *ppe, uint8_t *payload,
+                           size_t payloadlen) {
+  ngtcp2_buf *buf = &ppe->buf;
+  ngtcp2_crypto_cc *cc = ppe->cc;
+  ngtcp2_vec vec[NGTCP2_PPE_MAX_EXTCNT * 2 + 1];
+  size_t veccnt = 0;
+  uint8_t *p = payload, *q;
+  uint8_t *end = payload + payloadlen;
+  ngtcp2_ppe_ext *ext;
+  size_t i;
+
+  for (i = 0; i < ppe->extcnt; ++i) {
+    ext = &ppe->ext[i];
+    q = buf->begin + ext->offset;
+
+    assert(p <= q);
+
+    if (p != q) {
+      vec[veccnt].base = p;
+      vec[veccnt++].len = (size_t)(q - p);
+    }
+
+    vec[veccnt++] = ext->data;
+
+    p = q + ext->data.len;
+  }
+
+  assert(p <= end);
+
+  if (p != end) {
+    vec[veccnt].base = p;
+    vec[veccnt++].len = (size_t)(end - p);
+  }
+
+  return cc->encrypt_vec(payload, &cc->aead, &cc->ckm->aead_ctx, vec, veccnt,
+                         ppe->nonce, cc->ckm->iv.len, buf->begin, ppe->hdlen);
+}
+
+/*
+ * ppe_copy_ext copies STREAM data in ppe->ext into the buffer.
+ */
+static void ppe_copy_ext(ngtcp2_ppe *ppe) {
+  ngtcp2_ppe_ext *ext;
+  size_t i;
+
+  for (i = 0; i < ppe->extcnt; ++i) {
+    ext = &ppe->ext[i];
+    memcpy(ppe->buf.begin + ext->offset, ext->data.base, ext->data.len);
+  }
+
+  ppe->extcnt = 0;
+}
+
 ngtcp2_ssize ngtcp2_ppe_final(ngtcp2_ppe *ppe, const uint8_t **ppkt) {
   ngtcp2_buf *buf = &ppe->buf;
   ngtcp2_crypto_cc *cc = ppe->cc;
   uint8_t *payload = buf->begin + ppe->hdlen;
   size_t payloadlen = ngtcp2_buf_len(buf) - ppe->hdlen;
   uint8_t mask[NGTCP2_HP_SAMPLELEN];
-  uint8_t *p;
-  size_t i;
   int rv;
 
   assert(cc->encrypt);
@@ -123,39 +289,163 @@ ngtcp2_ssize ngtcp2_ppe_final(ngtcp2_ppe *ppe, const uint8_t **ppkt) {
   ngtcp2_crypto_create_nonce(ppe->nonce, cc->ckm->iv.base, cc->ckm->iv.len,
                              ppe->pkt_num);
 
-  rv = cc->encrypt(payload, &cc->aead, &cc->ckm->aead_ctx, payload, payloadlen,
-                   ppe->nonce, cc->ckm->iv.len, buf->begin, ppe->hdlen);
-  if (rv != 0) {
-    return NGTCP2_ERR_CALLBACK_FAILURE;
+  if (cc->encrypt_hp_mask && ppe->extcnt == 0) {
+    buf->last = payload + payloadlen + cc->aead.max_overhead;
+
+    /* TODO Check that we have enough space to get sample */
+    assert(ppe->sample_offset + NGTCP2_HP_SAMPLELEN <= ngtcp2_buf_len(buf));
+    assert(ppe->sample_offset >= ppe->hdlen);
+
+    /* The sample is taken from the ciphertext which the callback
+       writes, so that it can produce the mask in the same pass. */
+    rv = cc->encrypt_hp_mask(payload, mask, &cc->aead, &cc->ckm->aead_ctx,
+                             payload, payloadlen, ppe->nonce, cc->ckm->iv.len,
+                             buf->begin, ppe->hdlen, &cc->hp, &cc->hp_ctx,
+                             ppe->sample_offset - ppe->hdlen);
+    if (rv != 0) {
+      return NGTCP2_ERR_CALLBACK_FAILURE;
+    }
+  } else {
+    if (ppe->extcnt) {
+      rv = ppe_encrypt_vec(ppe, payload, payloadlen);
+    } else {
+      rv = cc->encrypt(payload, &cc->aead, &cc->ckm->aead_ctx, payload,
+                       payloadlen, ppe->nonce, cc->ckm->iv.len, buf->begin,
+                       ppe->hdlen);
+    }
+    if (rv != 0) {
+      return NGTCP2_ERR_CALLBACK_FAILURE;
+    }
+
+    buf->last = payload + payloadlen + cc->aead.max_overhead;
+
+    /* TODO Check that we have enough space to get sample */
+    assert(ppe->sample_offset + NGTCP2_HP_SAMPLELEN <= ngtcp2_buf_len(buf));
+
+    rv = cc->hp_mask(mask, &cc->hp, &cc->hp_ctx,
+                     buf->begin + ppe->sample_offset);
+    if (rv != 0) {
+      return NGTCP2_ERR_CALLBACK_FAILURE;
+    }
+  }
+
+  ppe_apply_hp(buf->begin, mask, ppe->pkt_num_offset, ppe->pkt_numlen);
+
+  if (ppkt != NULL) {
+    *ppkt = buf->begin;
   }
 
-  buf->last = payload + payloadlen + cc->aead.max_overhead;
+  return (ngtcp2_ssize)ngtcp2_buf_len(buf);
+}
+
+ngtcp2_ssize ngtcp2_ppe_final_deferred(ngtcp2_ppe *ppe,
+                                       ngtcp2_ppe_deferred *dpkt) {
+  ngtcp2_buf *buf = &ppe->buf;
+  ngtcp2_crypto_cc *cc = ppe->cc;
+  size_t payloadlen = ngtcp2_buf_len(buf) - ppe->hdlen;
+
+  /* Deferred protection encrypts contiguous payload. */
+  ppe_copy_ext(ppe);
+
+  if (ppe->len_offset) {
+    ngtcp2_put_varint30(
+        buf->begin + ppe->len_offset,
+        (uint16_t)(payloadlen + ppe->pkt_numlen + cc->aead.max_overhead));
+  }
+
+  buf->last += cc->aead.max_overhead;
 
-  /* TODO Check that we have enough space to get sample */
   assert(ppe->sample_offset + NGTCP2_HP_SAMPLELEN <= ngtcp2_buf_len(buf));
 
-  rv = cc->hp_mask(mask, &cc->hp, &cc->hp_ctx, buf->begin + ppe->sample_offset);
-  if (rv != 0) {
-    return NGTCP2_ERR_CALLBACK_FAILURE;
+  dpkt->pkt = buf->begin;
+  dpkt->hdlen = ppe->hdlen;
+  dpkt->payloadlen = payloadlen;
+  dpkt->pkt_num_offset = ppe->pkt_num_offset;
+  dpkt->pkt_numlen = ppe->pkt_numlen;
+  dpkt->sample_offset = ppe->sample_offset;
+  dpkt->pkt_num = ppe->pkt_num;
+
+  return (ngtcp2_ssize)ngtcp2_buf_len(buf);
+}
+
+int ngtcp2_ppe_protect_deferred(ngtcp2_crypto_cc *cc,
+                                ngtcp2_encrypt_batch encrypt_batch,
+                                ngtcp2_hp_mask_batch hp_mask_batch,
+                                ngtcp2_ppe_batch *batch,
+                                ngtcp2_ppe_deferred *dpkts, size_t dpktslen) {
+  ngtcp2_ppe_deferred *dpkt;
+  ngtcp2_encrypt_op *op;
+  uint8_t *mask;
+  size_t i;
+  int rv;
+
+  assert(dpktslen <= NGTCP2_PPE_MAX_BATCH);
+  assert(hp_mask_batch || cc->hp_mask);
+
+  for (i = 0; i < dpktslen; ++i) {
+    dpkt = &dpkts[i];
+    op = &batch->ops[i];
+
+    ngtcp2_crypto_create_nonce(dpkt->nonce, cc->ckm->iv.base, cc->ckm->iv.len,
+                               dpkt->pkt_num);
+
+    op->dest = dpkt->pkt + dpkt->hdlen;
+    op->plaintext = op->dest;
+    op->plaintextlen = dpkt->payloadlen;
+    op->nonce = dpkt->nonce;
+    op->noncelen = cc->ckm->iv.len;
+    op->aad = dpkt->pkt;
+    op->aadlen = dpkt->hdlen;
   }
 
-  p = buf->begin;
-  if (*p & NGTCP2_HEADER_FORM_BIT) {
-    *p = (uint8_t)(*p ^ (mask[0] & 0x0f));
+  if (encrypt_batch) {
+    rv = encrypt_batch(&cc->aead, &cc->ckm->aead_ctx, batch->ops, dpktslen);
+    if (rv != 0) {
+      return NGTCP2_ERR_CALLBACK_FAILURE;
+    }
   } else {
-    *p = (uint8_t)(*p ^ (mask[0] & 0x1f));
+    assert(cc->encrypt);
+
+    for (i = 0; i < dpktslen; ++i) {
+      op = &batch->ops[i];
+
+      rv = cc->encrypt(op->dest, &cc->aead, &cc->ckm->aead_ctx, op->plaintext,
+                       op->plaintextlen, op->nonce, op->noncelen, op->aad,
+                       op->aadlen);
+      if (rv != 0) {
+        return NGTCP2_ERR_CALLBACK_FAILURE;
+      }
+    }
   }
 
-  p = buf->begin + ppe->pkt_num_offset;
-  for (i = 0; i < ppe->pkt_numlen; ++i) {
-    *(p + i) ^= mask[i + 1];
+  if (hp_mask_batch) {
+    for (i = 0; i < dpktslen; ++i) {
+      batch->samples[i] = dpkts[i].pkt + dpkts[i].sample_offset;
+    }
+
+    rv = hp_mask_batch(batch->masks, &cc->hp, &cc->hp_ctx, batch->samples,
+                       dpktslen);
+    if (rv != 0) {
+      return NGTCP2_ERR_CALLBACK_FAILURE;
+    }
+  } else {
+    for (i = 0; i < dpktslen; ++i) {
+      rv = cc->hp_mask(batch->masks + i * NGTCP2_HP_SAMPLELEN, &cc->hp,
+                       &cc->hp_ctx, dpkts[i].pkt + dpkts[i].sample_offset);
+      if (rv != 0) {
+        return NGTCP2_ERR_CALLBACK_FAILURE;
+      }
+    }
   }
 
-  if (ppkt != NULL) {
-    *ppkt = buf->begin;
+  for (i = 0; i < dpktslen; ++i) {
+    dpkt = &dpkts[i];
+    mask = batch->masks + i * NGTCP2_HP_SAMPLELEN;
+
+    ppe_apply_hp(dpkt->pkt, mask, dpkt->pkt_num_offset, dpkt->pkt_numlen);
   }
 
-  return (ngtcp2_ssize)ngtcp2_buf_len(buf);
+  return 0;
 }
 
 size_t ngtcp2_ppe_left(ngtcp2_ppe *ppe) {
@@ -35,6 +35,23 @@
 #include "ngtcp2_buf.h"
 #include "ngtcp2_crypto.h"
 
+/* NGTCP2_PPE_MAX_EXTCNT is the maximum number of STREAM data vectors
+   which ngtcp2_ppe refers to instead of copying them into its
+   buffer. */
+#define NGTCP2_PPE_MAX_EXTCNT 16
+
+/*
+ * ngtcp2_ppe_ext is STREAM data which is not copied into the buffer.
+ * The buffer has the room for it, and its ciphertext is written there
+ * by ngtcp2_ppe_final.
+ */
+typedef struct ngtcp2_ppe_ext {
+  /* offset is the offset in buffer where the data belongs to. */
+  size_t offset;
+  /* data is the plaintext. */
+  ngtcp2_vec data;
+} ngtcp2_ppe_ext;
+
 /*
  * ngtcp2_ppe is the Protected Packet Encoder.
  */
@@ -58,8 +75,80 @@ typedef struct ngtcp2_ppe {
   /* nonce is the buffer to store nonce.  It should be equal or longer
      than then length of IV. */
   uint8_t nonce[32];
+  /* extcnt is the number of elements in ext. */
+  size_t extcnt;
+  /* ext contains STREAM data which is encrypted from the original
+     buffers by cc->encrypt_vec. */
+  ngtcp2_ppe_ext ext[NGTCP2_PPE_MAX_EXTCNT];
 } ngtcp2_ppe;
 
+/*
+ * ngtcp2_ppe_hd_tmpl is the encoded short header without packet
+ * number, that is, the first byte and Destination Connection ID.  It
+ * stays valid while Destination Connection ID, key phase, spin bit,
+ * and packet number length do not change, and
+ * ngtcp2_ppe_encode_hd_tmpl reuses it across packets.
+ * Zero-initialized object has no cached header.
+ */
+typedef struct ngtcp2_ppe_hd_tmpl {
+  /* dcid is Destination Connection ID which data is built with. */
+  ngtcp2_cid dcid;
+  /* len is the number of bytes cached in data.  0 means that nothing
+     is cached. */
+  size_t len;
+  /* flags is the bitwise OR of NGTCP2_PKT_FLAG_KEY_PHASE,
+     NGTCP2_PKT_FLAG_FIXED_BIT_CLEAR, and NGTCP2_PKT_FLAG_SPIN_BIT
+     which data is built with. */
+  uint8_t flags;
+  /* pkt_numlen is the length of packet number which data is built
+     with. */
+  uint8_t pkt_numlen;
+  uint8_t data[1 + NGTCP2_MAX_CIDLEN];
+} ngtcp2_ppe_hd_tmpl;
+
+/*
+ * ngtcp2_ppe_deferred holds the information of the packet whose
+ * protection is deferred.
+ */
+typedef struct ngtcp2_ppe_deferred {
+  /* pkt points to the beginning of the packet. */
+  uint8_t *pkt;
+  /* hdlen is the length of packet header. */
+  size_t hdlen;
+  /* payloadlen is the length of plaintext payload. */
+  size_t payloadlen;
+  /* pkt_num_offset is the offset to packet number field. */
+  size_t pkt_num_offset;
+  /* pkt_numlen is the number of bytes used to encode a packet
+     number */
+  size_t pkt_numlen;
+  /* sample_offset is the offset to sample for packet number
+     encryption. */
+  size_t sample_offset;
+  /* pkt_num is the packet number. */
+  int64_t pkt_num;
+  /* nonce is the buffer to store nonce. */
+  uint8_t nonce[32];
+} ngtcp2_ppe_deferred;
+
+/* NGTCP2_PPE_MAX_BATCH is the maximum number of packets which
+   ngtcp2_ppe_protect_deferred protects in one call. */
+#ifndef LOWMEMORY
+#  define NGTCP2_PPE_MAX_BATCH 64
+#else /* LOWMEMORY */
+#  define NGTCP2_PPE_MAX_BATCH 8
+#endif /* LOWMEMORY */
+
+/*
+ * ngtcp2_ppe_batch is the scratch buffer for
+ * ngtcp2_ppe_protect_deferred.
+ */
+typedef struct ngtcp2_ppe_batch {
+  ngtcp2_encrypt_op ops[NGTCP2_PPE_MAX_BATCH];
+  const uint8_t *samples[NGTCP2_PPE_MAX_BATCH];
+  uint8_t masks[NGTCP2_PPE_MAX_BATCH * NGTCP2_HP_SAMPLELEN];
+} ngtcp2_ppe_batch;
+
 /*
  * ngtcp2_ppe_init initializes |ppe| with the given buffer.
  */
@@ -77,6 +166,22 @@ void ngtcp2_ppe_init(ngtcp2_ppe *ppe, uint8_t *out, size_t outlen,
  */
 int ngtcp2_ppe_encode_hd(ngtcp2_ppe *ppe, const ngtcp2_pkt_hd *hd);
 
+/*
+ * ngtcp2_ppe_encode_hd_tmpl encodes short header |hd| like
+ * ngtcp2_ppe_encode_hd, but it copies the first byte and Destination
+ * Connection ID from |tmpl| if they are cached for |hd|, and only
+ * writes packet number.  Otherwise, |hd| is encoded from scratch, and
+ * |tmpl| is updated.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOBUF
+ *     The buffer is too small.
+ */
+int ngtcp2_ppe_encode_hd_tmpl(ngtcp2_ppe *ppe, ngtcp2_ppe_hd_tmpl *tmpl,
+                              const ngtcp2_pkt_hd *hd);
+
 /*
  * ngtcp2_ppe_encode_frame encodes |fr|.
  *
@@ -101,6 +206,42 @@ int ngtcp2_ppe_encode_frame(ngtcp2_ppe *ppe, ngtcp2_frame *fr);
  */
 ngtcp2_ssize ngtcp2_ppe_final(ngtcp2_ppe *ppe, const uint8_t **ppkt);
 
+/*
+ * ngtcp2_ppe_final_deferred finalizes QUIC packet like
+ * ngtcp2_ppe_final, but it does not encrypt payload nor apply header
+ * protection.  Instead, the information required to protect the
+ * packet later is stored in |dpkt|.  The packet must be protected by
+ * ngtcp2_ppe_protect_deferred before it is sent.
+ *
+ * This function returns the length of QUIC packet, including header,
+ * payload, and AEAD overhead.
+ */
+ngtcp2_ssize ngtcp2_ppe_final_deferred(ngtcp2_ppe *ppe,
+                                       ngtcp2_ppe_deferred *dpkt);
+
+/*
+ * ngtcp2_ppe_protect_deferred encrypts and applies header protection
+ * to |dpkts| of length |dpktslen| with |cc|.  All packets must be
+ * finalized by ngtcp2_ppe_final_deferred with |cc|.  |dpktslen| must
+ * not exceed NGTCP2_PPE_MAX_BATCH.  If |encrypt_batch| is not NULL,
+ * it is used to encrypt all packets in one call.  Otherwise,
+ * cc->encrypt is called for each packet.  Similarly, if
+ * |hp_mask_batch| is not NULL, it is used to produce all header
+ * protection masks in one call.  Otherwise, cc->hp_mask is called for
+ * each packet.  |batch| is used as a scratch buffer.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_CALLBACK_FAILURE
+ *     User-defined callback function failed.
+ */
+int ngtcp2_ppe_protect_deferred(ngtcp2_crypto_cc *cc,
+                                ngtcp2_encrypt_batch encrypt_batch,
+                                ngtcp2_hp_mask_batch hp_mask_batch,
+                                ngtcp2_ppe_batch *batch,
+                                ngtcp2_ppe_deferred *dpkts, size_t dpktslen);
+
 /*
  * ngtcp2_ppe_left returns the number of bytes left to write
  * additional frames.  This does not count AEAD overhead.
@@ -30,11 +30,22 @@
 #include "ngtcp2_macro.h"
 
 void ngtcp2_pq_init(ngtcp2_pq *pq, ngtcp2_less less, const ngtcp2_mem *mem) {
+  ngtcp2_pq_init_arity(pq, less, 2, mem);
+}
+
+void ngtcp2_pq_init_arity(ngtcp2_pq *pq, ngtcp2_less less, size_t arity,
+                          const ngtcp2_mem *mem) {
+  assert(arity >= 2);
+  assert((arity & (arity - 1)) == 0);
+
   pq->mem = mem;
   pq->capacity = 0;
   pq->q = NULL;
   pq->length = 0;
   pq->less = less;
+
+  for (pq->shift = 0; (1u << pq->shift) < arity; ++pq->shift)
+    ;
 }
 
 void ngtcp2_pq_free(ngtcp2_pq *pq) {
@@ -55,7 +66,7 @@ static void swap(ngtcp2_pq *pq, size_t i, size_t j) {
 static void bubble_up(ngtcp2_pq *pq, size_t index) {
   size_t parent;
   while (index != 0) {
-    parent = (index - 1) / 2;
+    parent = (index - 1) >> pq->shift;
     if (!pq->less(pq->q[index], pq->q[parent])) {
       return;
     }
@@ -93,10 +104,11 @@ ngtcp2_pq_entry *ngtcp2_pq_top(ngtcp2_pq *pq) {
 
 static void bubble_down(ngtcp2_pq *pq, size_t index) {
   size_t i, j, minindex;
+  size_t arity = (size_t)1 << pq->shift;
   for (;;) {
-    j = index * 2 + 1;
+    j = (index << pq->shift) + 1;
     minindex = index;
-    for (i = 0; i < 2; ++i, ++j) {
+    for (i = 0; i < arity; ++i, ++j) {
       if (j >= pq->length) {
         break;
       }
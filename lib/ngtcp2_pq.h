@@ -61,13 +61,26 @@ typedef struct ngtcp2_pq {
   size_t capacity;
   /* The less function between items */
   ngtcp2_less less;
+  /* shift is log2 of the number of children of each node. */
+  size_t shift;
 } ngtcp2_pq;
 
 /*
- * Initializes priority queue |pq| with compare function |cmp|.
+ * Initializes priority queue |pq| with compare function |cmp|.  |pq|
+ * is a binary heap.
  */
 void ngtcp2_pq_init(ngtcp2_pq *pq, ngtcp2_less less, const ngtcp2_mem *mem);
 
+/*
+ * ngtcp2_pq_init_arity initializes |pq| as |arity|-ary heap.  |arity|
+ * must be power of 2, and at least 2.  A larger arity makes the heap
+ * shallower, and the children of a node are compared in the adjacent
+ * memory, which reduces cache misses with a large number of items at
+ * the cost of more comparisons in ngtcp2_pq_pop.
+ */
+void ngtcp2_pq_init_arity(ngtcp2_pq *pq, ngtcp2_less less, size_t arity,
+                          const ngtcp2_mem *mem);
+
 /*
  * Deallocates any resources allocated for |pq|.  The stored items are
  * not freed by this function.
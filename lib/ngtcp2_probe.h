@@ -0,0 +1,69 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGTCP2_PROBE_H
+#define NGTCP2_PROBE_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+/*
+ * NGTCP2_PROBE* place a USDT (static user space) tracepoint named
+ * |NAME| in provider "ngtcp2".  With USDT enabled, each probe site is
+ * a single NOP instruction until a tracer (e.g., bpftrace, perf,
+ * SystemTap) attaches to it.  Otherwise, the probes expand to nothing
+ * and their arguments are not evaluated.
+ *
+ * The probes are:
+ *
+ * pkt_sent(conn, pkt_num, pkt_type, pktlen)
+ * pkt_recv(conn, pkt_num, pkt_type, pktlen)
+ * pkt_lost(conn, pktns_id, pkt_num, pktlen)
+ * cwnd(conn, cwnd, bytes_in_flight, ssthresh)
+ * pto(conn, pto_count)
+ * key_update(conn, pkt_num, initiator)
+ * stream_open(conn, stream_id)
+ * stream_close(conn, stream_id, app_error_code)
+ * flow_blocked(conn, stream_id, stream_offset, stream_max_offset,
+ *              conn_offset, conn_max_offset)
+ */
+#ifdef USDT
+#  include <sys/sdt.h>
+
+#  define NGTCP2_PROBE2(NAME, A1, A2) DTRACE_PROBE2(ngtcp2, NAME, A1, A2)
+#  define NGTCP2_PROBE3(NAME, A1, A2, A3)                                      \
+    DTRACE_PROBE3(ngtcp2, NAME, A1, A2, A3)
+#  define NGTCP2_PROBE4(NAME, A1, A2, A3, A4)                                  \
+    DTRACE_PROBE4(ngtcp2, NAME, A1, A2, A3, A4)
+#  define NGTCP2_PROBE6(NAME, A1, A2, A3, A4, A5, A6)                          \
+    DTRACE_PROBE6(ngtcp2, NAME, A1, A2, A3, A4, A5, A6)
+#else /* !USDT */
+#  define NGTCP2_PROBE2(NAME, A1, A2) ((void)0)
+#  define NGTCP2_PROBE3(NAME, A1, A2, A3) ((void)0)
+#  define NGTCP2_PROBE4(NAME, A1, A2, A3, A4) ((void)0)
+#  define NGTCP2_PROBE6(NAME, A1, A2, A3, A4, A5, A6) ((void)0)
+#endif /* !USDT */
+
+#endif /* NGTCP2_PROBE_H */
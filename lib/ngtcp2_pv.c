@@ -33,9 +33,11 @@
 #include "ngtcp2_addr.h"
 
 void ngtcp2_pv_entry_init(ngtcp2_pv_entry *pvent, const uint8_t *data,
-                          ngtcp2_tstamp expiry, uint8_t flags) {
+                          ngtcp2_tstamp expiry, uint8_t flags,
+                          ngtcp2_tstamp sent_ts) {
   memcpy(pvent->data, data, sizeof(pvent->data));
   pvent->expiry = expiry;
+  pvent->sent_ts = sent_ts;
   pvent->flags = flags;
 }
 
@@ -82,13 +84,14 @@ void ngtcp2_pv_add_entry(ngtcp2_pv *pv, const uint8_t *data,
   }
 
   ent = ngtcp2_ringbuf_push_back(&pv->ents.rb);
-  ngtcp2_pv_entry_init(ent, data, expiry, flags);
+  ngtcp2_pv_entry_init(ent, data, expiry, flags, ts);
 
   pv->flags &= (uint8_t)~NGTCP2_PV_FLAG_CANCEL_TIMER;
   --pv->probe_pkt_left;
 }
 
-int ngtcp2_pv_validate(ngtcp2_pv *pv, uint8_t *pflags, const uint8_t *data) {
+int ngtcp2_pv_validate(ngtcp2_pv *pv, uint8_t *pflags, const uint8_t *data,
+                       ngtcp2_tstamp ts) {
   size_t len = ngtcp2_ringbuf_len(&pv->ents.rb);
   size_t i;
   ngtcp2_pv_entry *ent;
@@ -101,6 +104,10 @@ int ngtcp2_pv_validate(ngtcp2_pv *pv, uint8_t *pflags, const uint8_t *data) {
     ent = ngtcp2_ringbuf_get(&pv->ents.rb, i);
     if (memcmp(ent->data, data, sizeof(ent->data)) == 0) {
       *pflags = ent->flags;
+
+      ngtcp2_dcid_add_rtt_sample(&pv->dcid, ts - ent->sent_ts);
+      pv->dcid.validated_ts = ts;
+
       ngtcp2_log_info(pv->log, NGTCP2_LOG_EVENT_PTV, "path has been validated");
       return 0;
     }
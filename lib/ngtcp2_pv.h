@@ -54,6 +54,8 @@ typedef struct ngtcp2_frame_chain ngtcp2_frame_chain;
 typedef struct ngtcp2_pv_entry {
   /* expiry is the timestamp when this PATH_CHALLENGE expires. */
   ngtcp2_tstamp expiry;
+  /* sent_ts is the timestamp when this PATH_CHALLENGE is sent. */
+  ngtcp2_tstamp sent_ts;
   /* flags is zero or more of NGTCP2_PV_ENTRY_FLAG_*. */
   uint8_t flags;
   /* data is a byte string included in PATH_CHALLENGE. */
@@ -61,7 +63,8 @@ typedef struct ngtcp2_pv_entry {
 } ngtcp2_pv_entry;
 
 void ngtcp2_pv_entry_init(ngtcp2_pv_entry *pvent, const uint8_t *data,
-                          ngtcp2_tstamp expiry, uint8_t flags);
+                          ngtcp2_tstamp expiry, uint8_t flags,
+                          ngtcp2_tstamp sent_ts);
 
 /* NGTCP2_PV_FLAG_NONE indicates no flag is set. */
 #define NGTCP2_PV_FLAG_NONE 0x00u
@@ -155,6 +158,8 @@ int ngtcp2_pv_full(ngtcp2_pv *pv);
  * ngtcp2_pv_validate validates that the received |data| matches the
  * one of the existing entry.  The flag of ngtcp2_pv_entry that
  * matches |data| is assigned to |*pflags| if this function succeeds.
+ * The round-trip time of the entry measured at |ts| is recorded to
+ * pv->dcid.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -166,7 +171,8 @@ int ngtcp2_pv_full(ngtcp2_pv *pv);
  * NGTCP2_ERR_INVALID_ARGUMENT
  *     |pv| does not have an entry which has |data| and |path|
  */
-int ngtcp2_pv_validate(ngtcp2_pv *pv, uint8_t *pflags, const uint8_t *data);
+int ngtcp2_pv_validate(ngtcp2_pv *pv, uint8_t *pflags, const uint8_t *data,
+                       ngtcp2_tstamp ts);
 
 /*
  * ngtcp2_pv_handle_entry_expiry checks expiry of existing entries.
@@ -31,10 +31,18 @@
 #include "ngtcp2_conv.h"
 #include "ngtcp2_net.h"
 
-void ngtcp2_qlog_init(ngtcp2_qlog *qlog, ngtcp2_qlog_write write,
+#ifndef NOQLOG
+void ngtcp2_qlog_init(ngtcp2_qlog *qlog, const ngtcp2_qlog_settings *settings,
                       ngtcp2_tstamp ts, void *user_data) {
-  qlog->write = write;
-  qlog->ts = qlog->last_ts = ts;
+  qlog->write = settings->write;
+  qlog->format = settings->format;
+  qlog->ts = qlog->last_ts = qlog->bin_ts = ts;
+  qlog->filter = settings->filter;
+  qlog->pkt_sample_interval = settings->pkt_sample_interval;
+  qlog->metrics_sample_interval = settings->metrics_sample_interval;
+  qlog->npkt = 0;
+  qlog->nmetrics = 0;
+  qlog->pkt_active = 0;
   qlog->user_data = user_data;
 }
 
@@ -208,6 +216,573 @@ static uint8_t *write_trace(uint8_t *p, int server, const ngtcp2_cid *odcid) {
   return p;
 }
 
+/*
+ * Binary encoding.  See ngtcp2_qlog.h for the layout.
+ */
+
+/* NGTCP2_QLOG_BIN_EVENT_PREFIXLEN is the space reserved in front of
+   packet_sent and packet_received events to write event type,
+   timestamp, body length and frames length after all frames are
+   written. */
+#define NGTCP2_QLOG_BIN_EVENT_PREFIXLEN 25
+
+/* NGTCP2_QLOG_BIN_FRAME_OVERHEAD is the maximum length of a frame
+   excluding ACK ranges and the token of NEW_TOKEN frame. */
+#define NGTCP2_QLOG_BIN_FRAME_OVERHEAD 64
+
+/* NGTCP2_QLOG_BIN_PKT_HD_OVERHEAD is the maximum length of a packet
+   header excluding token. */
+#define NGTCP2_QLOG_BIN_PKT_HD_OVERHEAD 17
+
+static uint8_t *bin_put_varint(uint8_t *p, uint64_t n) {
+  if (n > NGTCP2_MAX_VARINT) {
+    n = NGTCP2_MAX_VARINT;
+  }
+  return ngtcp2_put_varint(p, n);
+}
+
+static size_t bin_put_varint_len(uint64_t n) {
+  if (n > NGTCP2_MAX_VARINT) {
+    n = NGTCP2_MAX_VARINT;
+  }
+  return ngtcp2_put_varint_len(n);
+}
+
+static uint8_t *bin_put_bytes(uint8_t *p, const uint8_t *data,
+                              size_t datalen) {
+  p = bin_put_varint(p, datalen);
+  if (datalen) {
+    p = ngtcp2_cpymem(p, data, datalen);
+  }
+  return p;
+}
+
+static uint8_t *bin_put_cid(uint8_t *p, const ngtcp2_cid *cid) {
+  return bin_put_bytes(p, cid->data, cid->datalen);
+}
+
+static ngtcp2_qlog_bin_pkt_type bin_pkt_type(const ngtcp2_pkt_hd *hd) {
+  if (hd->flags & NGTCP2_PKT_FLAG_LONG_FORM) {
+    switch (hd->type) {
+    case NGTCP2_PKT_INITIAL:
+      return NGTCP2_QLOG_BIN_PKT_TYPE_INITIAL;
+    case NGTCP2_PKT_HANDSHAKE:
+      return NGTCP2_QLOG_BIN_PKT_TYPE_HANDSHAKE;
+    case NGTCP2_PKT_0RTT:
+      return NGTCP2_QLOG_BIN_PKT_TYPE_0RTT;
+    case NGTCP2_PKT_RETRY:
+      return NGTCP2_QLOG_BIN_PKT_TYPE_RETRY;
+    default:
+      return NGTCP2_QLOG_BIN_PKT_TYPE_UNKNOWN;
+    }
+  }
+
+  switch (hd->type) {
+  case NGTCP2_PKT_VERSION_NEGOTIATION:
+    return NGTCP2_QLOG_BIN_PKT_TYPE_VERSION_NEGOTIATION;
+  case NGTCP2_PKT_STATELESS_RESET:
+    return NGTCP2_QLOG_BIN_PKT_TYPE_STATELESS_RESET;
+  case NGTCP2_PKT_1RTT:
+    return NGTCP2_QLOG_BIN_PKT_TYPE_1RTT;
+  default:
+    return NGTCP2_QLOG_BIN_PKT_TYPE_UNKNOWN;
+  }
+}
+
+static uint8_t *bin_put_pkt_hd(uint8_t *p, const ngtcp2_pkt_hd *hd) {
+  *p++ = (uint8_t)bin_pkt_type(hd);
+  p = bin_put_varint(p, (uint64_t)hd->pkt_num);
+  if (hd->type == NGTCP2_PKT_INITIAL && hd->token.len) {
+    return bin_put_bytes(p, hd->token.base, hd->token.len);
+  }
+  *p++ = 0;
+  return p;
+}
+
+/*
+ * bin_put_event_prefix writes event type |ev|, the elapsed time since
+ * the previous event, and |bodylen| to |p|.
+ */
+static uint8_t *bin_put_event_prefix(ngtcp2_qlog *qlog, uint8_t *p,
+                                     ngtcp2_qlog_bin_event ev,
+                                     size_t bodylen) {
+  ngtcp2_duration d = 0;
+
+  if (qlog->last_ts > qlog->bin_ts) {
+    d = qlog->last_ts - qlog->bin_ts;
+    qlog->bin_ts = qlog->last_ts;
+  }
+
+  *p++ = (uint8_t)ev;
+  p = bin_put_varint(p, d);
+  return bin_put_varint(p, bodylen);
+}
+
+/*
+ * bin_write_event writes an event |ev| whose body is |body| of length
+ * |bodylen| to qlog->write.  |body| must be preceded by at least
+ * NGTCP2_QLOG_BIN_EVENT_PREFIXLEN bytes of free space.
+ */
+static void bin_write_event(ngtcp2_qlog *qlog, ngtcp2_qlog_bin_event ev,
+                            uint8_t *body, size_t bodylen) {
+  uint8_t prefix[NGTCP2_QLOG_BIN_EVENT_PREFIXLEN];
+  uint8_t *p = bin_put_event_prefix(qlog, prefix, ev, bodylen);
+  size_t prefixlen = (size_t)(p - prefix);
+  uint8_t *begin = body - prefixlen;
+
+  ngtcp2_cpymem(begin, prefix, prefixlen);
+
+  qlog->write(qlog->user_data, NGTCP2_QLOG_WRITE_FLAG_NONE, begin,
+              prefixlen + bodylen);
+}
+
+static void bin_start(ngtcp2_qlog *qlog, const ngtcp2_cid *odcid,
+                      int server) {
+  uint8_t buf[64];
+  uint8_t *p = buf;
+
+  p = write_verbatim(p, NGTCP2_QLOG_BIN_MAGIC);
+  p = bin_put_varint(p, NGTCP2_QLOG_BIN_VERSION);
+  *p++ = server ? 1 : 0;
+  p = bin_put_cid(p, odcid);
+
+  qlog->write(qlog->user_data, NGTCP2_QLOG_WRITE_FLAG_NONE, buf,
+              (size_t)(p - buf));
+}
+
+/*
+ * qlog_ack_num_blks returns the number of the additional ACK Ranges
+ * of |fr| which are logged.  A received ACK frame may carry more
+ * ranges than a qlog buffer can hold, and only the ones in fr->blks
+ * are logged.
+ */
+static size_t qlog_ack_num_blks(const ngtcp2_ack *fr) {
+  return ngtcp2_min((size_t)fr->num_blks, NGTCP2_MAX_ACK_BLKS);
+}
+
+static uint8_t *bin_put_ack_frame(uint8_t *p, const ngtcp2_ack *fr) {
+  size_t i, num_blks = qlog_ack_num_blks(fr);
+
+  p = bin_put_varint(p, fr->ack_delay_unscaled);
+  p = bin_put_varint(p, (uint64_t)fr->largest_ack);
+  p = bin_put_varint(p, fr->first_ack_blklen);
+  p = bin_put_varint(p, num_blks);
+
+  for (i = 0; i < num_blks; ++i) {
+    p = bin_put_varint(p, fr->blks[i].gap);
+    p = bin_put_varint(p, fr->blks[i].blklen);
+  }
+
+  if (fr->type == NGTCP2_FRAME_ACK_ECN) {
+    p = bin_put_varint(p, fr->ecn.ect1);
+    p = bin_put_varint(p, fr->ecn.ect0);
+    p = bin_put_varint(p, fr->ecn.ce);
+  }
+
+  return p;
+}
+
+static void bin_write_frame(ngtcp2_qlog *qlog, const ngtcp2_frame *fr) {
+  uint8_t *p = qlog->buf.last;
+  size_t need = NGTCP2_QLOG_BIN_FRAME_OVERHEAD;
+
+  switch (fr->type) {
+  case NGTCP2_FRAME_ACK:
+  case NGTCP2_FRAME_ACK_ECN:
+    need += qlog_ack_num_blks(&fr->ack) * 16;
+    break;
+  case NGTCP2_FRAME_NEW_TOKEN:
+    need += fr->new_token.token.len;
+    break;
+  }
+
+  /* Keep the space for the packet header and packet length written
+     by bin_pkt_write_end. */
+  if (ngtcp2_buf_left(&qlog->buf) <
+      need + NGTCP2_QLOG_BIN_PKT_HD_OVERHEAD + 8) {
+    return;
+  }
+
+  p = bin_put_varint(p, fr->type);
+
+  switch (fr->type) {
+  case NGTCP2_FRAME_PADDING:
+  case NGTCP2_FRAME_PING:
+  case NGTCP2_FRAME_DATA_BLOCKED:
+  case NGTCP2_FRAME_STREAM_DATA_BLOCKED:
+  case NGTCP2_FRAME_STREAMS_BLOCKED_BIDI:
+  case NGTCP2_FRAME_STREAMS_BLOCKED_UNI:
+  case NGTCP2_FRAME_HANDSHAKE_DONE:
+  case NGTCP2_FRAME_IMMEDIATE_ACK:
+    break;
+  case NGTCP2_FRAME_ACK:
+  case NGTCP2_FRAME_ACK_ECN:
+    p = bin_put_ack_frame(p, &fr->ack);
+    break;
+  case NGTCP2_FRAME_RESET_STREAM:
+    p = bin_put_varint(p, (uint64_t)fr->reset_stream.stream_id);
+    p = bin_put_varint(p, fr->reset_stream.app_error_code);
+    p = bin_put_varint(p, fr->reset_stream.final_size);
+    break;
+  case NGTCP2_FRAME_STOP_SENDING:
+    p = bin_put_varint(p, (uint64_t)fr->stop_sending.stream_id);
+    p = bin_put_varint(p, fr->stop_sending.app_error_code);
+    break;
+  case NGTCP2_FRAME_CRYPTO:
+    p = bin_put_varint(p, fr->crypto.offset);
+    p = bin_put_varint(p,
+                       ngtcp2_vec_len(fr->crypto.data, fr->crypto.datacnt));
+    break;
+  case NGTCP2_FRAME_NEW_TOKEN:
+    p = bin_put_bytes(p, fr->new_token.token.base, fr->new_token.token.len);
+    break;
+  case NGTCP2_FRAME_STREAM:
+    *p++ = fr->stream.fin ? 1 : 0;
+    p = bin_put_varint(p, (uint64_t)fr->stream.stream_id);
+    p = bin_put_varint(p, fr->stream.offset);
+    p = bin_put_varint(p,
+                       ngtcp2_vec_len(fr->stream.data, fr->stream.datacnt));
+    break;
+  case NGTCP2_FRAME_MAX_DATA:
+    p = bin_put_varint(p, fr->max_data.max_data);
+    break;
+  case NGTCP2_FRAME_MAX_STREAM_DATA:
+    p = bin_put_varint(p, (uint64_t)fr->max_stream_data.stream_id);
+    p = bin_put_varint(p, fr->max_stream_data.max_stream_data);
+    break;
+  case NGTCP2_FRAME_MAX_STREAMS_BIDI:
+  case NGTCP2_FRAME_MAX_STREAMS_UNI:
+    p = bin_put_varint(p, fr->max_streams.max_streams);
+    break;
+  case NGTCP2_FRAME_NEW_CONNECTION_ID:
+    p = bin_put_varint(p, fr->new_connection_id.seq);
+    p = bin_put_varint(p, fr->new_connection_id.retire_prior_to);
+    p = bin_put_cid(p, &fr->new_connection_id.cid);
+    p = ngtcp2_cpymem(p, fr->new_connection_id.stateless_reset_token,
+                      NGTCP2_STATELESS_RESET_TOKENLEN);
+    break;
+  case NGTCP2_FRAME_RETIRE_CONNECTION_ID:
+    p = bin_put_varint(p, fr->retire_connection_id.seq);
+    break;
+  case NGTCP2_FRAME_PATH_CHALLENGE:
+    p = ngtcp2_cpymem(p, fr->path_challenge.data,
+                      sizeof(fr->path_challenge.data));
+    break;
+  case NGTCP2_FRAME_PATH_RESPONSE:
+    p = ngtcp2_cpymem(p, fr->path_response.data,
+                      sizeof(fr->path_response.data));
+    break;
+  case NGTCP2_FRAME_CONNECTION_CLOSE:
+  case NGTCP2_FRAME_CONNECTION_CLOSE_APP:
+    p = bin_put_varint(p, fr->connection_close.error_code);
+    break;
+  case NGTCP2_FRAME_DATAGRAM:
+  case NGTCP2_FRAME_DATAGRAM_LEN:
+    p = bin_put_varint(
+        p, ngtcp2_vec_len(fr->datagram.data, fr->datagram.datacnt));
+    break;
+  case NGTCP2_FRAME_ACK_FREQUENCY:
+    p = bin_put_varint(p, fr->ack_frequency.seq);
+    p = bin_put_varint(p, fr->ack_frequency.ack_eliciting_threshold);
+    p = bin_put_varint(p, fr->ack_frequency.request_max_ack_delay);
+    p = bin_put_varint(p, fr->ack_frequency.reordering_threshold);
+    break;
+  case NGTCP2_FRAME_REPAIR:
+    p = bin_put_varint(p, (uint64_t)fr->repair.stream_id);
+    p = bin_put_varint(p, fr->repair.offset);
+    p = bin_put_varint(p, fr->repair.symbolcnt);
+    p = bin_put_varint(p, fr->repair.data.len);
+    break;
+  default:
+    assert(0);
+  }
+
+  qlog->buf.last = p;
+}
+
+static void bin_pkt_write_start(ngtcp2_qlog *qlog) {
+  ngtcp2_buf_reset(&qlog->buf);
+  qlog->buf.last += NGTCP2_QLOG_BIN_EVENT_PREFIXLEN;
+  qlog->buf.pos = qlog->buf.last;
+}
+
+static void bin_pkt_write_end(ngtcp2_qlog *qlog, ngtcp2_qlog_bin_event ev,
+                              const ngtcp2_pkt_hd *hd, size_t pktlen) {
+  uint8_t prefix[NGTCP2_QLOG_BIN_EVENT_PREFIXLEN];
+  uint8_t *p;
+  size_t frameslen = ngtcp2_buf_len(&qlog->buf);
+  size_t trailerlen, prefixlen, bodylen;
+
+  if (ngtcp2_buf_left(&qlog->buf) <
+      NGTCP2_QLOG_BIN_PKT_HD_OVERHEAD + hd->token.len + 8) {
+    return;
+  }
+
+  p = bin_put_pkt_hd(qlog->buf.last, hd);
+  p = bin_put_varint(p, pktlen);
+  trailerlen = (size_t)(p - qlog->buf.last);
+  qlog->buf.last = p;
+
+  bodylen = bin_put_varint_len(frameslen) + frameslen + trailerlen;
+
+  p = bin_put_event_prefix(qlog, prefix, ev, bodylen);
+  p = bin_put_varint(p, frameslen);
+  prefixlen = (size_t)(p - prefix);
+
+  qlog->buf.pos -= prefixlen;
+  ngtcp2_cpymem(qlog->buf.pos, prefix, prefixlen);
+
+  qlog->write(qlog->user_data, NGTCP2_QLOG_WRITE_FLAG_NONE, qlog->buf.pos,
+              ngtcp2_buf_len(&qlog->buf));
+}
+
+/*
+ * bin_parameters_set writes the body of parameters_set event in the
+ * following order: varint owner (0: local, 1: remote), varint flags
+ * (0x01: original_dcid present, 0x02: retry_scid present, 0x04:
+ * stateless_reset_token present, 0x08: preferred_address present,
+ * 0x10: disable_active_migration, 0x20: grease_quic_bit),
+ * initial_scid, [original_dcid], [retry_scid],
+ * [stateless_reset_token], max_idle_timeout, max_udp_payload_size,
+ * ack_delay_exponent, max_ack_delay, active_connection_id_limit,
+ * initial_max_data, initial_max_stream_data_bidi_local,
+ * initial_max_stream_data_bidi_remote, initial_max_stream_data_uni,
+ * initial_max_streams_bidi, initial_max_streams_uni,
+ * [preferred_address: 4 bytes ipv4 address, varint ipv4 port, 16
+ * bytes ipv6 address, varint ipv6 port, cid, stateless_reset_token],
+ * max_datagram_frame_size.
+ */
+static void bin_parameters_set(ngtcp2_qlog *qlog,
+                               const ngtcp2_transport_params *params,
+                               int server, ngtcp2_qlog_side side) {
+  uint8_t buf[512];
+  uint8_t *body = buf + NGTCP2_QLOG_BIN_EVENT_PREFIXLEN;
+  uint8_t *p = body;
+  const ngtcp2_preferred_addr *paddr;
+  uint8_t flags = 0;
+  int odcid_present =
+      side == (server ? NGTCP2_QLOG_SIDE_LOCAL : NGTCP2_QLOG_SIDE_REMOTE);
+
+  if (odcid_present) {
+    flags |= 0x01;
+  }
+  if (params->retry_scid_present) {
+    flags |= 0x02;
+  }
+  if (params->stateless_reset_token_present) {
+    flags |= 0x04;
+  }
+  if (params->preferred_address_present) {
+    flags |= 0x08;
+  }
+  if (params->disable_active_migration) {
+    flags |= 0x10;
+  }
+  if (params->grease_quic_bit) {
+    flags |= 0x20;
+  }
+
+  *p++ = side == NGTCP2_QLOG_SIDE_LOCAL ? 0 : 1;
+  *p++ = flags;
+  p = bin_put_cid(p, &params->initial_scid);
+  if (odcid_present) {
+    p = bin_put_cid(p, &params->original_dcid);
+  }
+  if (params->retry_scid_present) {
+    p = bin_put_cid(p, &params->retry_scid);
+  }
+  if (params->stateless_reset_token_present) {
+    p = ngtcp2_cpymem(p, params->stateless_reset_token,
+                      sizeof(params->stateless_reset_token));
+  }
+  p = bin_put_varint(p, params->max_idle_timeout);
+  p = bin_put_varint(p, params->max_udp_payload_size);
+  p = bin_put_varint(p, params->ack_delay_exponent);
+  p = bin_put_varint(p, params->max_ack_delay);
+  p = bin_put_varint(p, params->active_connection_id_limit);
+  p = bin_put_varint(p, params->initial_max_data);
+  p = bin_put_varint(p, params->initial_max_stream_data_bidi_local);
+  p = bin_put_varint(p, params->initial_max_stream_data_bidi_remote);
+  p = bin_put_varint(p, params->initial_max_stream_data_uni);
+  p = bin_put_varint(p, params->initial_max_streams_bidi);
+  p = bin_put_varint(p, params->initial_max_streams_uni);
+  if (params->preferred_address_present) {
+    paddr = &params->preferred_address;
+    p = ngtcp2_cpymem(p, paddr->ipv4_addr, sizeof(paddr->ipv4_addr));
+    p = bin_put_varint(p, paddr->ipv4_port);
+    p = ngtcp2_cpymem(p, paddr->ipv6_addr, sizeof(paddr->ipv6_addr));
+    p = bin_put_varint(p, paddr->ipv6_port);
+    p = bin_put_cid(p, &paddr->cid);
+    p = ngtcp2_cpymem(p, paddr->stateless_reset_token,
+                      sizeof(paddr->stateless_reset_token));
+  }
+  p = bin_put_varint(p, params->max_datagram_frame_size);
+
+  bin_write_event(qlog, NGTCP2_QLOG_BIN_EVENT_PARAMETERS_SET, body,
+                  (size_t)(p - body));
+}
+
+static void bin_metrics_updated(ngtcp2_qlog *qlog,
+                                const ngtcp2_conn_stat *cstat) {
+  uint8_t buf[NGTCP2_QLOG_BIN_EVENT_PREFIXLEN + 160];
+  uint8_t *body = buf + NGTCP2_QLOG_BIN_EVENT_PREFIXLEN;
+  uint8_t *p = body;
+  uint8_t flags = 0;
+
+  if (cstat->min_rtt != UINT64_MAX) {
+    flags |= 0x01;
+  }
+  if (cstat->ssthresh != UINT64_MAX) {
+    flags |= 0x02;
+  }
+  if (cstat->bbr2_state != NGTCP2_BBR2_STATE_NONE) {
+    flags |= 0x04;
+    if (cstat->bbr2_bw_lo != UINT64_MAX) {
+      flags |= 0x08;
+    }
+    if (cstat->bbr2_inflight_hi != UINT64_MAX) {
+      flags |= 0x10;
+    }
+    if (cstat->bbr2_inflight_lo != UINT64_MAX) {
+      flags |= 0x20;
+    }
+  }
+
+  *p++ = flags;
+  if (flags & 0x01) {
+    p = bin_put_varint(p, cstat->min_rtt);
+  }
+  p = bin_put_varint(p, cstat->smoothed_rtt);
+  p = bin_put_varint(p, cstat->latest_rtt);
+  p = bin_put_varint(p, cstat->rttvar);
+  p = bin_put_varint(p, cstat->pto_count);
+  p = bin_put_varint(p, cstat->cwnd);
+  p = bin_put_varint(p, cstat->bytes_in_flight);
+  if (flags & 0x02) {
+    p = bin_put_varint(p, cstat->ssthresh);
+  }
+  if (flags & 0x04) {
+    p = bin_put_varint(p, (uint64_t)cstat->bbr2_state);
+    p = bin_put_varint(p, cstat->bbr2_max_bw);
+    if (flags & 0x08) {
+      p = bin_put_varint(p, cstat->bbr2_bw_lo);
+    }
+    if (flags & 0x10) {
+      p = bin_put_varint(p, cstat->bbr2_inflight_hi);
+    }
+    if (flags & 0x20) {
+      p = bin_put_varint(p, cstat->bbr2_inflight_lo);
+    }
+    p = bin_put_varint(p, cstat->bbr2_inflight_too_high_count);
+  }
+
+  bin_write_event(qlog, NGTCP2_QLOG_BIN_EVENT_METRICS_UPDATED, body,
+                  (size_t)(p - body));
+}
+
+static void bin_pkt_lost(ngtcp2_qlog *qlog, ngtcp2_rtb_entry *ent) {
+  uint8_t buf[NGTCP2_QLOG_BIN_EVENT_PREFIXLEN + 32];
+  uint8_t *body = buf + NGTCP2_QLOG_BIN_EVENT_PREFIXLEN;
+  uint8_t *p;
+  ngtcp2_pkt_hd hd = {0};
+
+  hd.type = ent->hd.type;
+  hd.flags = ent->hd.flags;
+  hd.pkt_num = ent->hd.pkt_num;
+
+  p = bin_put_pkt_hd(body, &hd);
+
+  bin_write_event(qlog, NGTCP2_QLOG_BIN_EVENT_PKT_LOST, body,
+                  (size_t)(p - body));
+}
+
+static void bin_send_limited(ngtcp2_qlog *qlog, ngtcp2_stall_cause cause) {
+  uint8_t buf[NGTCP2_QLOG_BIN_EVENT_PREFIXLEN + 8];
+  uint8_t *body = buf + NGTCP2_QLOG_BIN_EVENT_PREFIXLEN;
+  uint8_t *p;
+
+  p = bin_put_varint(body, (uint64_t)cause);
+
+  bin_write_event(qlog, NGTCP2_QLOG_BIN_EVENT_SEND_LIMITED, body,
+                  (size_t)(p - body));
+}
+
+static void bin_pto_probe_sent(ngtcp2_qlog *qlog, int64_t pkt_num,
+                               ngtcp2_pto_probe_policy policy,
+                               int retransmission) {
+  uint8_t buf[NGTCP2_QLOG_BIN_EVENT_PREFIXLEN + 24];
+  uint8_t *body = buf + NGTCP2_QLOG_BIN_EVENT_PREFIXLEN;
+  uint8_t *p;
+
+  p = bin_put_varint(body, (uint64_t)pkt_num);
+  p = bin_put_varint(p, (uint64_t)policy);
+  p = bin_put_varint(p, retransmission != 0);
+
+  bin_write_event(qlog, NGTCP2_QLOG_BIN_EVENT_PTO_PROBE_SENT, body,
+                  (size_t)(p - body));
+}
+
+static void bin_retry_pkt_received(ngtcp2_qlog *qlog, const ngtcp2_pkt_hd *hd,
+                                   const ngtcp2_pkt_retry *retry) {
+  uint8_t buf[1024];
+  uint8_t *body = buf + NGTCP2_QLOG_BIN_EVENT_PREFIXLEN;
+  uint8_t *p = body;
+
+  if (sizeof(buf) - NGTCP2_QLOG_BIN_EVENT_PREFIXLEN <
+      NGTCP2_QLOG_BIN_PKT_HD_OVERHEAD + hd->token.len + 8 + retry->token.len) {
+    return;
+  }
+
+  p = bin_put_pkt_hd(p, hd);
+  p = bin_put_bytes(p, retry->token.base, retry->token.len);
+
+  bin_write_event(qlog, NGTCP2_QLOG_BIN_EVENT_RETRY_RECEIVED, body,
+                  (size_t)(p - body));
+}
+
+static void bin_stateless_reset_pkt_received(
+    ngtcp2_qlog *qlog, const ngtcp2_pkt_stateless_reset *sr) {
+  uint8_t buf[NGTCP2_QLOG_BIN_EVENT_PREFIXLEN + 64];
+  uint8_t *body = buf + NGTCP2_QLOG_BIN_EVENT_PREFIXLEN;
+  uint8_t *p;
+  ngtcp2_pkt_hd hd = {0};
+
+  hd.type = NGTCP2_PKT_STATELESS_RESET;
+
+  p = bin_put_pkt_hd(body, &hd);
+  p = ngtcp2_cpymem(p, sr->stateless_reset_token,
+                    NGTCP2_STATELESS_RESET_TOKENLEN);
+
+  bin_write_event(qlog, NGTCP2_QLOG_BIN_EVENT_STATELESS_RESET_RECEIVED, body,
+                  (size_t)(p - body));
+}
+
+static void bin_version_negotiation_pkt_received(ngtcp2_qlog *qlog,
+                                                 const ngtcp2_pkt_hd *hd,
+                                                 const uint32_t *sv,
+                                                 size_t nsv) {
+  uint8_t buf[512];
+  uint8_t *body = buf + NGTCP2_QLOG_BIN_EVENT_PREFIXLEN;
+  uint8_t *p = body;
+  size_t i;
+
+  if (sizeof(buf) - NGTCP2_QLOG_BIN_EVENT_PREFIXLEN <
+      NGTCP2_QLOG_BIN_PKT_HD_OVERHEAD + hd->token.len + 8 + nsv * 4) {
+    return;
+  }
+
+  p = bin_put_pkt_hd(p, hd);
+  p = bin_put_varint(p, nsv);
+
+  for (i = 0; i < nsv; ++i) {
+    p = ngtcp2_put_uint32be(p, sv[i]);
+  }
+
+  bin_write_event(qlog,
+                  NGTCP2_QLOG_BIN_EVENT_VERSION_NEGOTIATION_RECEIVED, body,
+                  (size_t)(p - body));
+}
+
 void ngtcp2_qlog_start(ngtcp2_qlog *qlog, const ngtcp2_cid *odcid, int server) {
   uint8_t buf[1024];
   uint8_t *p = buf;
@@ -216,6 +791,11 @@ void ngtcp2_qlog_start(ngtcp2_qlog *qlog, const ngtcp2_cid *odcid, int server) {
     return;
   }
 
+  if (qlog->format == NGTCP2_QLOG_FORMAT_BINARY) {
+    bin_start(qlog, odcid, server);
+    return;
+  }
+
   p = write_verbatim(
       p, "\x1e{\"qlog_format\":\"JSON-SEQ\",\"qlog_version\":\"0.3\",");
   p = write_trace(p, server, odcid);
@@ -315,7 +895,7 @@ static uint8_t *write_ping_frame(uint8_t *p, const ngtcp2_ping *fr) {
 
 static uint8_t *write_ack_frame(uint8_t *p, const ngtcp2_ack *fr) {
   int64_t largest_ack, min_ack;
-  size_t i;
+  size_t i, num_blks = qlog_ack_num_blks(fr);
   const ngtcp2_ack_blk *blk;
 
   /*
@@ -346,7 +926,7 @@ static uint8_t *write_ack_frame(uint8_t *p, const ngtcp2_ack *fr) {
   }
   *p++ = ']';
 
-  for (i = 0; i < fr->num_blks; ++i) {
+  for (i = 0; i < num_blks; ++i) {
     blk = &fr->blks[i];
     largest_ack = min_ack - (int64_t)blk->gap - 2;
     min_ack = largest_ack - (int64_t)blk->blklen;
@@ -671,10 +1251,70 @@ static uint8_t *write_datagram_frame(uint8_t *p, const ngtcp2_datagram *fr) {
   return p;
 }
 
+static uint8_t *write_ack_frequency_frame(uint8_t *p,
+                                          const ngtcp2_ack_frequency *fr) {
+  /*
+   * {"frame_type":"ack_frequency","sequence_number":0000000000000000000,"ack_eliciting_threshold":0000000000000000000,"request_max_ack_delay":0000000000000000000,"reordering_threshold":0000000000000000000}
+   */
+#define NGTCP2_QLOG_ACK_FREQUENCY_FRAME_OVERHEAD 201
+
+  p = write_verbatim(p, "{\"frame_type\":\"ack_frequency\",");
+  p = write_pair_number(p, "sequence_number", fr->seq);
+  *p++ = ',';
+  p = write_pair_number(p, "ack_eliciting_threshold",
+                        fr->ack_eliciting_threshold);
+  *p++ = ',';
+  p = write_pair_number(p, "request_max_ack_delay", fr->request_max_ack_delay);
+  *p++ = ',';
+  p = write_pair_number(p, "reordering_threshold", fr->reordering_threshold);
+  *p++ = '}';
+
+  return p;
+}
+
+static uint8_t *write_repair_frame(uint8_t *p, const ngtcp2_repair *fr) {
+  /*
+   * {"frame_type":"repair","stream_id":0000000000000000000,"offset":0000000000000000000,"symbol_count":0000000000000000000,"length":0000000000000000000}
+   */
+#define NGTCP2_QLOG_REPAIR_FRAME_OVERHEAD 148
+
+  p = write_verbatim(p, "{\"frame_type\":\"repair\",");
+  p = write_pair_number(p, "stream_id", (uint64_t)fr->stream_id);
+  *p++ = ',';
+  p = write_pair_number(p, "offset", fr->offset);
+  *p++ = ',';
+  p = write_pair_number(p, "symbol_count", fr->symbolcnt);
+  *p++ = ',';
+  p = write_pair_number(p, "length", fr->data.len);
+  *p++ = '}';
+
+  return p;
+}
+
+static uint8_t *write_immediate_ack_frame(uint8_t *p,
+                                          const ngtcp2_immediate_ack *fr) {
+  (void)fr;
+
+  /*
+   * {"frame_type":"immediate_ack"}
+   */
+#define NGTCP2_QLOG_IMMEDIATE_ACK_FRAME_OVERHEAD 30
+
+  return write_verbatim(p, "{\"frame_type\":\"immediate_ack\"}");
+}
+
 static uint8_t *qlog_write_time(ngtcp2_qlog *qlog, uint8_t *p) {
   return write_pair_tstamp(p, "time", qlog->last_ts - qlog->ts);
 }
 
+/*
+ * qlog_sampled returns nonzero if the |*pn|-th event should be
+ * written with sampling |interval|, and increments |*pn|.
+ */
+static int qlog_sampled(uint64_t *pn, uint32_t interval) {
+  return interval <= 1 || (*pn)++ % interval == 0;
+}
+
 static void qlog_pkt_write_start(ngtcp2_qlog *qlog, int sent) {
   uint8_t *p;
 
@@ -682,6 +1322,17 @@ static void qlog_pkt_write_start(ngtcp2_qlog *qlog, int sent) {
     return;
   }
 
+  qlog->pkt_active = !(qlog->filter & NGTCP2_QLOG_FILTER_PKT) &&
+                     qlog_sampled(&qlog->npkt, qlog->pkt_sample_interval);
+  if (!qlog->pkt_active) {
+    return;
+  }
+
+  if (qlog->format == NGTCP2_QLOG_FORMAT_BINARY) {
+    bin_pkt_write_start(qlog);
+    return;
+  }
+
   ngtcp2_buf_reset(&qlog->buf);
   p = qlog->buf.last;
 
@@ -698,11 +1349,21 @@ static void qlog_pkt_write_start(ngtcp2_qlog *qlog, int sent) {
   qlog->buf.last = p;
 }
 
-static void qlog_pkt_write_end(ngtcp2_qlog *qlog, const ngtcp2_pkt_hd *hd,
-                               size_t pktlen) {
+static void qlog_pkt_write_end(ngtcp2_qlog *qlog, int sent,
+                               const ngtcp2_pkt_hd *hd, size_t pktlen) {
   uint8_t *p = qlog->buf.last;
 
-  if (!qlog->write) {
+  if (!qlog->write || !qlog->pkt_active) {
+    return;
+  }
+
+  qlog->pkt_active = 0;
+
+  if (qlog->format == NGTCP2_QLOG_FORMAT_BINARY) {
+    bin_pkt_write_end(qlog,
+                      sent ? NGTCP2_QLOG_BIN_EVENT_PKT_SENT
+                           : NGTCP2_QLOG_BIN_EVENT_PKT_RECEIVED,
+                      hd, pktlen);
     return;
   }
 
@@ -741,7 +1402,13 @@ static void qlog_pkt_write_end(ngtcp2_qlog *qlog, const ngtcp2_pkt_hd *hd,
 void ngtcp2_qlog_write_frame(ngtcp2_qlog *qlog, const ngtcp2_frame *fr) {
   uint8_t *p = qlog->buf.last;
 
-  if (!qlog->write) {
+  if (!qlog->write || !qlog->pkt_active ||
+      (qlog->filter & NGTCP2_QLOG_FILTER_FRAMES)) {
+    return;
+  }
+
+  if (qlog->format == NGTCP2_QLOG_FORMAT_BINARY) {
+    bin_write_frame(qlog, fr);
     return;
   }
 
@@ -765,7 +1432,9 @@ void ngtcp2_qlog_write_frame(ngtcp2_qlog *qlog, const ngtcp2_frame *fr) {
             (size_t)(fr->type == NGTCP2_FRAME_ACK_ECN
                          ? NGTCP2_QLOG_ACK_FRAME_ECN_OVERHEAD
                          : 0) +
-            NGTCP2_QLOG_ACK_FRAME_RANGE_OVERHEAD * (1 + fr->ack.num_blks) + 1) {
+            NGTCP2_QLOG_ACK_FRAME_RANGE_OVERHEAD *
+                (1 + qlog_ack_num_blks(&fr->ack)) +
+            1) {
       return;
     }
     p = write_ack_frame(p, &fr->ack);
@@ -896,6 +1565,26 @@ void ngtcp2_qlog_write_frame(ngtcp2_qlog *qlog, const ngtcp2_frame *fr) {
     }
     p = write_datagram_frame(p, &fr->datagram);
     break;
+  case NGTCP2_FRAME_ACK_FREQUENCY:
+    if (ngtcp2_buf_left(&qlog->buf) <
+        NGTCP2_QLOG_ACK_FREQUENCY_FRAME_OVERHEAD + 1) {
+      return;
+    }
+    p = write_ack_frequency_frame(p, &fr->ack_frequency);
+    break;
+  case NGTCP2_FRAME_IMMEDIATE_ACK:
+    if (ngtcp2_buf_left(&qlog->buf) <
+        NGTCP2_QLOG_IMMEDIATE_ACK_FRAME_OVERHEAD + 1) {
+      return;
+    }
+    p = write_immediate_ack_frame(p, &fr->immediate_ack);
+    break;
+  case NGTCP2_FRAME_REPAIR:
+    if (ngtcp2_buf_left(&qlog->buf) < NGTCP2_QLOG_REPAIR_FRAME_OVERHEAD + 1) {
+      return;
+    }
+    p = write_repair_frame(p, &fr->repair);
+    break;
   default:
     assert(0);
   }
@@ -911,7 +1600,7 @@ void ngtcp2_qlog_pkt_received_start(ngtcp2_qlog *qlog) {
 
 void ngtcp2_qlog_pkt_received_end(ngtcp2_qlog *qlog, const ngtcp2_pkt_hd *hd,
                                   size_t pktlen) {
-  qlog_pkt_write_end(qlog, hd, pktlen);
+  qlog_pkt_write_end(qlog, /* sent = */ 0, hd, pktlen);
 }
 
 void ngtcp2_qlog_pkt_sent_start(ngtcp2_qlog *qlog) {
@@ -920,7 +1609,7 @@ void ngtcp2_qlog_pkt_sent_start(ngtcp2_qlog *qlog) {
 
 void ngtcp2_qlog_pkt_sent_end(ngtcp2_qlog *qlog, const ngtcp2_pkt_hd *hd,
                               size_t pktlen) {
-  qlog_pkt_write_end(qlog, hd, pktlen);
+  qlog_pkt_write_end(qlog, /* sent = */ 1, hd, pktlen);
 }
 
 void ngtcp2_qlog_parameters_set_transport_params(
@@ -930,7 +1619,12 @@ void ngtcp2_qlog_parameters_set_transport_params(
   uint8_t *p = buf;
   const ngtcp2_preferred_addr *paddr;
 
-  if (!qlog->write) {
+  if (!qlog->write || (qlog->filter & NGTCP2_QLOG_FILTER_PARAMETERS)) {
+    return;
+  }
+
+  if (qlog->format == NGTCP2_QLOG_FORMAT_BINARY) {
+    bin_parameters_set(qlog, params, server, side);
     return;
   }
 
@@ -1028,12 +1722,52 @@ void ngtcp2_qlog_parameters_set_transport_params(
               (size_t)(p - buf));
 }
 
+static ngtcp2_vec vec_bbr2_state_startup = ngtcp2_make_vec_lit("startup");
+static ngtcp2_vec vec_bbr2_state_drain = ngtcp2_make_vec_lit("drain");
+static ngtcp2_vec vec_bbr2_state_probe_bw_down =
+    ngtcp2_make_vec_lit("probe_bw_down");
+static ngtcp2_vec vec_bbr2_state_probe_bw_cruise =
+    ngtcp2_make_vec_lit("probe_bw_cruise");
+static ngtcp2_vec vec_bbr2_state_probe_bw_refill =
+    ngtcp2_make_vec_lit("probe_bw_refill");
+static ngtcp2_vec vec_bbr2_state_probe_bw_up =
+    ngtcp2_make_vec_lit("probe_bw_up");
+static ngtcp2_vec vec_bbr2_state_probe_rtt = ngtcp2_make_vec_lit("probe_rtt");
+static ngtcp2_vec vec_bbr2_state_unknown = ngtcp2_make_vec_lit("unknown");
+
+static const ngtcp2_vec *qlog_bbr2_state(ngtcp2_bbr2_state state) {
+  switch (state) {
+  case NGTCP2_BBR2_STATE_STARTUP:
+    return &vec_bbr2_state_startup;
+  case NGTCP2_BBR2_STATE_DRAIN:
+    return &vec_bbr2_state_drain;
+  case NGTCP2_BBR2_STATE_PROBE_BW_DOWN:
+    return &vec_bbr2_state_probe_bw_down;
+  case NGTCP2_BBR2_STATE_PROBE_BW_CRUISE:
+    return &vec_bbr2_state_probe_bw_cruise;
+  case NGTCP2_BBR2_STATE_PROBE_BW_REFILL:
+    return &vec_bbr2_state_probe_bw_refill;
+  case NGTCP2_BBR2_STATE_PROBE_BW_UP:
+    return &vec_bbr2_state_probe_bw_up;
+  case NGTCP2_BBR2_STATE_PROBE_RTT:
+    return &vec_bbr2_state_probe_rtt;
+  default:
+    return &vec_bbr2_state_unknown;
+  }
+}
+
 void ngtcp2_qlog_metrics_updated(ngtcp2_qlog *qlog,
                                  const ngtcp2_conn_stat *cstat) {
   uint8_t buf[1024];
   uint8_t *p = buf;
 
-  if (!qlog->write) {
+  if (!qlog->write || (qlog->filter & NGTCP2_QLOG_FILTER_METRICS) ||
+      !qlog_sampled(&qlog->nmetrics, qlog->metrics_sample_interval)) {
+    return;
+  }
+
+  if (qlog->format == NGTCP2_QLOG_FORMAT_BINARY) {
+    bin_metrics_updated(qlog, cstat);
     return;
   }
 
@@ -1061,6 +1795,27 @@ void ngtcp2_qlog_metrics_updated(ngtcp2_qlog *qlog,
     *p++ = ',';
     p = write_pair_number(p, "ssthresh", cstat->ssthresh);
   }
+  if (cstat->bbr2_state != NGTCP2_BBR2_STATE_NONE) {
+    *p++ = ',';
+    p = write_pair(p, "bbr2_state", qlog_bbr2_state(cstat->bbr2_state));
+    *p++ = ',';
+    p = write_pair_number(p, "bbr2_max_bw", cstat->bbr2_max_bw);
+    if (cstat->bbr2_bw_lo != UINT64_MAX) {
+      *p++ = ',';
+      p = write_pair_number(p, "bbr2_bw_lo", cstat->bbr2_bw_lo);
+    }
+    if (cstat->bbr2_inflight_hi != UINT64_MAX) {
+      *p++ = ',';
+      p = write_pair_number(p, "bbr2_inflight_hi", cstat->bbr2_inflight_hi);
+    }
+    if (cstat->bbr2_inflight_lo != UINT64_MAX) {
+      *p++ = ',';
+      p = write_pair_number(p, "bbr2_inflight_lo", cstat->bbr2_inflight_lo);
+    }
+    *p++ = ',';
+    p = write_pair_number(p, "bbr2_inflight_too_high_count",
+                          cstat->bbr2_inflight_too_high_count);
+  }
 
   p = write_verbatim(p, "}}\n");
 
@@ -1073,7 +1828,12 @@ void ngtcp2_qlog_pkt_lost(ngtcp2_qlog *qlog, ngtcp2_rtb_entry *ent) {
   uint8_t *p = buf;
   ngtcp2_pkt_hd hd = {0};
 
-  if (!qlog->write) {
+  if (!qlog->write || (qlog->filter & NGTCP2_QLOG_FILTER_LOSS)) {
+    return;
+  }
+
+  if (qlog->format == NGTCP2_QLOG_FORMAT_BINARY) {
+    bin_pkt_lost(qlog, ent);
     return;
   }
 
@@ -1094,12 +1854,116 @@ void ngtcp2_qlog_pkt_lost(ngtcp2_qlog *qlog, ngtcp2_rtb_entry *ent) {
               (size_t)(p - buf));
 }
 
+static ngtcp2_vec vec_stall_cause_none = ngtcp2_make_vec_lit("none");
+static ngtcp2_vec vec_stall_cause_cwnd = ngtcp2_make_vec_lit("cwnd");
+static ngtcp2_vec vec_stall_cause_pacing = ngtcp2_make_vec_lit("pacing");
+static ngtcp2_vec vec_stall_cause_conn_flow_control =
+    ngtcp2_make_vec_lit("connection_flow_control");
+static ngtcp2_vec vec_stall_cause_stream_flow_control =
+    ngtcp2_make_vec_lit("stream_flow_control");
+static ngtcp2_vec vec_stall_cause_app = ngtcp2_make_vec_lit("application");
+
+static const ngtcp2_vec *qlog_stall_cause(ngtcp2_stall_cause cause) {
+  switch (cause) {
+  case NGTCP2_STALL_CAUSE_CWND:
+    return &vec_stall_cause_cwnd;
+  case NGTCP2_STALL_CAUSE_PACING:
+    return &vec_stall_cause_pacing;
+  case NGTCP2_STALL_CAUSE_CONN_FLOW_CONTROL:
+    return &vec_stall_cause_conn_flow_control;
+  case NGTCP2_STALL_CAUSE_STREAM_FLOW_CONTROL:
+    return &vec_stall_cause_stream_flow_control;
+  case NGTCP2_STALL_CAUSE_APP:
+    return &vec_stall_cause_app;
+  default:
+    return &vec_stall_cause_none;
+  }
+}
+
+void ngtcp2_qlog_send_limited(ngtcp2_qlog *qlog, ngtcp2_stall_cause cause) {
+  uint8_t buf[128];
+  uint8_t *p = buf;
+
+  if (!qlog->write || (qlog->filter & NGTCP2_QLOG_FILTER_METRICS)) {
+    return;
+  }
+
+  if (qlog->format == NGTCP2_QLOG_FORMAT_BINARY) {
+    bin_send_limited(qlog, cause);
+    return;
+  }
+
+  *p++ = '\x1e';
+  *p++ = '{';
+  p = qlog_write_time(qlog, p);
+  p = write_verbatim(p, ",\"name\":\"transport:send_limited\",\"data\":{");
+  p = write_pair(p, "cause", qlog_stall_cause(cause));
+  p = write_verbatim(p, "}}\n");
+
+  qlog->write(qlog->user_data, NGTCP2_QLOG_WRITE_FLAG_NONE, buf,
+              (size_t)(p - buf));
+}
+
+static ngtcp2_vec vec_pto_probe_policy_new_data_first =
+    ngtcp2_make_vec_lit("new_data_first");
+static ngtcp2_vec vec_pto_probe_policy_retransmit_oldest =
+    ngtcp2_make_vec_lit("retransmit_oldest");
+static ngtcp2_vec vec_pto_probe_policy_duplicate_latest =
+    ngtcp2_make_vec_lit("duplicate_latest");
+
+static const ngtcp2_vec *
+qlog_pto_probe_policy(ngtcp2_pto_probe_policy policy) {
+  switch (policy) {
+  case NGTCP2_PTO_PROBE_POLICY_RETRANSMIT_OLDEST:
+    return &vec_pto_probe_policy_retransmit_oldest;
+  case NGTCP2_PTO_PROBE_POLICY_DUPLICATE_LATEST:
+    return &vec_pto_probe_policy_duplicate_latest;
+  default:
+    return &vec_pto_probe_policy_new_data_first;
+  }
+}
+
+void ngtcp2_qlog_pto_probe_sent(ngtcp2_qlog *qlog, int64_t pkt_num,
+                                ngtcp2_pto_probe_policy policy,
+                                int retransmission) {
+  uint8_t buf[256];
+  uint8_t *p = buf;
+
+  if (!qlog->write || (qlog->filter & NGTCP2_QLOG_FILTER_LOSS)) {
+    return;
+  }
+
+  if (qlog->format == NGTCP2_QLOG_FORMAT_BINARY) {
+    bin_pto_probe_sent(qlog, pkt_num, policy, retransmission);
+    return;
+  }
+
+  *p++ = '\x1e';
+  *p++ = '{';
+  p = qlog_write_time(qlog, p);
+  p = write_verbatim(p, ",\"name\":\"recovery:pto_probe_sent\",\"data\":{");
+  p = write_pair_number(p, "packet_number", (uint64_t)pkt_num);
+  *p++ = ',';
+  p = write_pair(p, "policy", qlog_pto_probe_policy(policy));
+  *p++ = ',';
+  p = write_pair_bool(p, "retransmission", retransmission);
+  p = write_verbatim(p, "}}\n");
+
+  qlog->write(qlog->user_data, NGTCP2_QLOG_WRITE_FLAG_NONE, buf,
+              (size_t)(p - buf));
+}
+
 void ngtcp2_qlog_retry_pkt_received(ngtcp2_qlog *qlog, const ngtcp2_pkt_hd *hd,
                                     const ngtcp2_pkt_retry *retry) {
   uint8_t rawbuf[1024];
   ngtcp2_buf buf;
 
-  if (!qlog->write) {
+  if (!qlog->write || (qlog->filter & NGTCP2_QLOG_FILTER_PKT)) {
+    return;
+  }
+
+  if (qlog->format == NGTCP2_QLOG_FORMAT_BINARY) {
+    bin_retry_pkt_received(qlog, hd, retry);
     return;
   }
 
@@ -1135,7 +1999,12 @@ void ngtcp2_qlog_stateless_reset_pkt_received(
   uint8_t *p = buf;
   ngtcp2_pkt_hd hd = {0};
 
-  if (!qlog->write) {
+  if (!qlog->write || (qlog->filter & NGTCP2_QLOG_FILTER_PKT)) {
+    return;
+  }
+
+  if (qlog->format == NGTCP2_QLOG_FORMAT_BINARY) {
+    bin_stateless_reset_pkt_received(qlog, sr);
     return;
   }
 
@@ -1165,7 +2034,12 @@ void ngtcp2_qlog_version_negotiation_pkt_received(ngtcp2_qlog *qlog,
   size_t i;
   uint32_t v;
 
-  if (!qlog->write) {
+  if (!qlog->write || (qlog->filter & NGTCP2_QLOG_FILTER_PKT)) {
+    return;
+  }
+
+  if (qlog->format == NGTCP2_QLOG_FORMAT_BINARY) {
+    bin_version_negotiation_pkt_received(qlog, hd, sv, nsv);
     return;
   }
 
@@ -1201,3 +2075,4 @@ void ngtcp2_qlog_version_negotiation_pkt_received(ngtcp2_qlog *qlog,
   qlog->write(qlog->user_data, NGTCP2_QLOG_WRITE_FLAG_NONE, buf.pos,
               ngtcp2_buf_len(&buf));
 }
+#endif /* NOQLOG */
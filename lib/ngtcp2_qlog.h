@@ -35,6 +35,7 @@
 #include "ngtcp2_cc.h"
 #include "ngtcp2_buf.h"
 #include "ngtcp2_rtb.h"
+#include "ngtcp2_stall.h"
 
 /* NGTCP2_QLOG_BUFLEN is the length of heap allocated buffer for
    qlog. */
@@ -45,13 +46,103 @@ typedef enum ngtcp2_qlog_side {
   NGTCP2_QLOG_SIDE_REMOTE,
 } ngtcp2_qlog_side;
 
+/*
+ * Binary qlog (NGTCP2_QLOG_FORMAT_BINARY) starts with the preamble:
+ *
+ *   magic "NGQB", varint version (NGTCP2_QLOG_BIN_VERSION), varint
+ *   vantage point (0: client, 1: server), varint ODCID length, ODCID
+ *
+ * followed by a sequence of events:
+ *
+ *   varint event type (ngtcp2_qlog_bin_event), varint nanoseconds
+ *   elapsed since the previous event (or the initial timestamp),
+ *   varint body length, body
+ *
+ * All integers are QUIC variable-length integers, and durations are
+ * in nanoseconds.  Values which do not fit in a varint are clamped
+ * to NGTCP2_MAX_VARINT.  A decoder skips an event of unknown type
+ * using its body length.  A packet header (hd) is varint packet type
+ * (ngtcp2_qlog_bin_pkt_type), varint packet number, varint token
+ * length, token.  A connection ID (cid) is varint length, data.  The
+ * body of each event is:
+ *
+ *   PKT_SENT, PKT_RECEIVED: varint frames length, frames, hd, varint
+ *     packet length.  Each frame is its varint QUIC frame type
+ *     followed by its fields in the order the JSON encoder writes
+ *     them.
+ *   PARAMETERS_SET: see bin_parameters_set in ngtcp2_qlog.c.
+ *   METRICS_UPDATED: varint flags (0x1: min_rtt present, 0x2:
+ *     ssthresh present, 0x4: BBR v2 fields present, 0x8: bbr2_bw_lo
+ *     present, 0x10: bbr2_inflight_hi present, 0x20:
+ *     bbr2_inflight_lo present), [min_rtt], smoothed_rtt,
+ *     latest_rtt, rttvar, pto_count, cwnd, bytes_in_flight,
+ *     [ssthresh], [bbr2_state, bbr2_max_bw, [bbr2_bw_lo],
+ *     [bbr2_inflight_hi], [bbr2_inflight_lo],
+ *     bbr2_inflight_too_high_count].
+ *   PKT_LOST: hd.
+ *   SEND_LIMITED: varint cause (ngtcp2_stall_cause).
+ *   PTO_PROBE_SENT: varint packet number, varint policy
+ *     (ngtcp2_pto_probe_policy), varint retransmission (0 or 1).
+ *   RETRY_RECEIVED: hd, varint retry token length, retry token.
+ *   STATELESS_RESET_RECEIVED: hd, 16 bytes stateless reset token.
+ *   VERSION_NEGOTIATION_RECEIVED: hd, varint number of versions, 4
+ *     bytes version in network byte order each.
+ */
+#define NGTCP2_QLOG_BIN_MAGIC "NGQB"
+#define NGTCP2_QLOG_BIN_VERSION 1
+
+typedef enum ngtcp2_qlog_bin_event {
+  NGTCP2_QLOG_BIN_EVENT_PKT_SENT = 0x01,
+  NGTCP2_QLOG_BIN_EVENT_PKT_RECEIVED = 0x02,
+  NGTCP2_QLOG_BIN_EVENT_PARAMETERS_SET = 0x03,
+  NGTCP2_QLOG_BIN_EVENT_METRICS_UPDATED = 0x04,
+  NGTCP2_QLOG_BIN_EVENT_PKT_LOST = 0x05,
+  NGTCP2_QLOG_BIN_EVENT_RETRY_RECEIVED = 0x06,
+  NGTCP2_QLOG_BIN_EVENT_STATELESS_RESET_RECEIVED = 0x07,
+  NGTCP2_QLOG_BIN_EVENT_VERSION_NEGOTIATION_RECEIVED = 0x08,
+  NGTCP2_QLOG_BIN_EVENT_SEND_LIMITED = 0x09,
+  NGTCP2_QLOG_BIN_EVENT_PTO_PROBE_SENT = 0x0a,
+} ngtcp2_qlog_bin_event;
+
+typedef enum ngtcp2_qlog_bin_pkt_type {
+  NGTCP2_QLOG_BIN_PKT_TYPE_INITIAL = 0x00,
+  NGTCP2_QLOG_BIN_PKT_TYPE_HANDSHAKE = 0x01,
+  NGTCP2_QLOG_BIN_PKT_TYPE_0RTT = 0x02,
+  NGTCP2_QLOG_BIN_PKT_TYPE_1RTT = 0x03,
+  NGTCP2_QLOG_BIN_PKT_TYPE_RETRY = 0x04,
+  NGTCP2_QLOG_BIN_PKT_TYPE_VERSION_NEGOTIATION = 0x05,
+  NGTCP2_QLOG_BIN_PKT_TYPE_STATELESS_RESET = 0x06,
+  NGTCP2_QLOG_BIN_PKT_TYPE_UNKNOWN = 0x07,
+} ngtcp2_qlog_bin_pkt_type;
+
 typedef struct ngtcp2_qlog {
   /* write is a callback function to write qlog. */
   ngtcp2_qlog_write write;
+  /* format is the encoding of qlog. */
+  ngtcp2_qlog_format format;
   /* ts is the initial timestamp */
   ngtcp2_tstamp ts;
   /* last_ts is the timestamp observed last time. */
   ngtcp2_tstamp last_ts;
+  /* bin_ts is the timestamp of the last event written in binary
+     format. */
+  ngtcp2_tstamp bin_ts;
+  /* filter is bitwise OR of NGTCP2_QLOG_FILTER_*. */
+  uint32_t filter;
+  /* pkt_sample_interval is the interval of packet events to write.
+     0 or 1 writes all of them. */
+  uint32_t pkt_sample_interval;
+  /* metrics_sample_interval is the interval of metrics_updated
+     events to write.  0 or 1 writes all of them. */
+  uint32_t metrics_sample_interval;
+  /* npkt is the number of packet events seen so far. */
+  uint64_t npkt;
+  /* nmetrics is the number of metrics_updated events seen so far. */
+  uint64_t nmetrics;
+  /* pkt_active is nonzero if the packet event which is being written
+     passed filter and sampling.  Frames are written only if it is
+     nonzero. */
+  int pkt_active;
   /* buf is a heap allocated buffer to write exclusively
      packet_received and packet_sent. */
   ngtcp2_buf buf;
@@ -60,10 +151,11 @@ typedef struct ngtcp2_qlog {
   void *user_data;
 } ngtcp2_qlog;
 
+#ifndef NOQLOG
 /*
- * ngtcp2_qlog_init initializes |qlog|.
+ * ngtcp2_qlog_init initializes |qlog| with |settings|.
  */
-void ngtcp2_qlog_init(ngtcp2_qlog *qlog, ngtcp2_qlog_write write,
+void ngtcp2_qlog_init(ngtcp2_qlog *qlog, const ngtcp2_qlog_settings *settings,
                       ngtcp2_tstamp ts, void *user_data);
 
 /*
@@ -135,6 +227,23 @@ void ngtcp2_qlog_metrics_updated(ngtcp2_qlog *qlog,
  */
 void ngtcp2_qlog_pkt_lost(ngtcp2_qlog *qlog, ngtcp2_rtb_entry *ent);
 
+/*
+ * ngtcp2_qlog_send_limited writes send_limited event which tells
+ * that sending is now limited by |cause|, or is no longer limited if
+ * |cause| is NGTCP2_STALL_CAUSE_NONE.
+ */
+void ngtcp2_qlog_send_limited(ngtcp2_qlog *qlog, ngtcp2_stall_cause cause);
+
+/*
+ * ngtcp2_qlog_pto_probe_sent writes pto_probe_sent event which tells
+ * that a PTO probe packet |pkt_num| is sent under |policy|.
+ * |retransmission| is nonzero if the packet carries the frames
+ * reclaimed from the in-flight packets.
+ */
+void ngtcp2_qlog_pto_probe_sent(ngtcp2_qlog *qlog, int64_t pkt_num,
+                                ngtcp2_pto_probe_policy policy,
+                                int retransmission);
+
 /*
  * ngtcp2_qlog_retry_pkt_received writes packet_received event for a
  * received Retry packet.
@@ -158,4 +267,128 @@ void ngtcp2_qlog_version_negotiation_pkt_received(ngtcp2_qlog *qlog,
                                                   const uint32_t *sv,
                                                   size_t nsv);
 
+#else /* NOQLOG */
+
+/* If NOQLOG is defined, the qlog functions are compiled to nothing,
+   and ngtcp2_qlog_init leaves write NULL so that no buffer is
+   allocated for qlog. */
+
+static inline void ngtcp2_qlog_init(ngtcp2_qlog *qlog,
+                                    const ngtcp2_qlog_settings *settings,
+                                    ngtcp2_tstamp ts, void *user_data) {
+  (void)settings;
+
+  qlog->write = NULL;
+  qlog->format = NGTCP2_QLOG_FORMAT_JSON_SEQ;
+  qlog->ts = qlog->last_ts = qlog->bin_ts = ts;
+  qlog->filter = 0;
+  qlog->pkt_sample_interval = 0;
+  qlog->metrics_sample_interval = 0;
+  qlog->npkt = 0;
+  qlog->nmetrics = 0;
+  qlog->pkt_active = 0;
+  ngtcp2_buf_init(&qlog->buf, NULL, 0);
+  qlog->user_data = user_data;
+}
+
+static inline void ngtcp2_qlog_start(ngtcp2_qlog *qlog,
+                                     const ngtcp2_cid *odcid, int server) {
+  (void)qlog;
+  (void)odcid;
+  (void)server;
+}
+
+static inline void ngtcp2_qlog_end(ngtcp2_qlog *qlog) { (void)qlog; }
+
+static inline void ngtcp2_qlog_write_frame(ngtcp2_qlog *qlog,
+                                           const ngtcp2_frame *fr) {
+  (void)qlog;
+  (void)fr;
+}
+
+static inline void ngtcp2_qlog_pkt_received_start(ngtcp2_qlog *qlog) {
+  (void)qlog;
+}
+
+static inline void ngtcp2_qlog_pkt_received_end(ngtcp2_qlog *qlog,
+                                                const ngtcp2_pkt_hd *hd,
+                                                size_t pktlen) {
+  (void)qlog;
+  (void)hd;
+  (void)pktlen;
+}
+
+static inline void ngtcp2_qlog_pkt_sent_start(ngtcp2_qlog *qlog) {
+  (void)qlog;
+}
+
+static inline void ngtcp2_qlog_pkt_sent_end(ngtcp2_qlog *qlog,
+                                            const ngtcp2_pkt_hd *hd,
+                                            size_t pktlen) {
+  (void)qlog;
+  (void)hd;
+  (void)pktlen;
+}
+
+static inline void ngtcp2_qlog_parameters_set_transport_params(
+    ngtcp2_qlog *qlog, const ngtcp2_transport_params *params, int server,
+    ngtcp2_qlog_side side) {
+  (void)qlog;
+  (void)params;
+  (void)server;
+  (void)side;
+}
+
+static inline void ngtcp2_qlog_metrics_updated(ngtcp2_qlog *qlog,
+                                               const ngtcp2_conn_stat *cstat) {
+  (void)qlog;
+  (void)cstat;
+}
+
+static inline void ngtcp2_qlog_pkt_lost(ngtcp2_qlog *qlog,
+                                        ngtcp2_rtb_entry *ent) {
+  (void)qlog;
+  (void)ent;
+}
+
+static inline void ngtcp2_qlog_send_limited(ngtcp2_qlog *qlog,
+                                            ngtcp2_stall_cause cause) {
+  (void)qlog;
+  (void)cause;
+}
+
+static inline void
+ngtcp2_qlog_pto_probe_sent(ngtcp2_qlog *qlog, int64_t pkt_num,
+                           ngtcp2_pto_probe_policy policy, int retransmission) {
+  (void)qlog;
+  (void)pkt_num;
+  (void)policy;
+  (void)retransmission;
+}
+
+static inline void
+ngtcp2_qlog_retry_pkt_received(ngtcp2_qlog *qlog, const ngtcp2_pkt_hd *hd,
+                               const ngtcp2_pkt_retry *retry) {
+  (void)qlog;
+  (void)hd;
+  (void)retry;
+}
+
+static inline void ngtcp2_qlog_stateless_reset_pkt_received(
+    ngtcp2_qlog *qlog, const ngtcp2_pkt_stateless_reset *sr) {
+  (void)qlog;
+  (void)sr;
+}
+
+static inline void ngtcp2_qlog_version_negotiation_pkt_received(
+    ngtcp2_qlog *qlog, const ngtcp2_pkt_hd *hd, const uint32_t *sv,
+    size_t nsv) {
+  (void)qlog;
+  (void)hd;
+  (void)sv;
+  (void)nsv;
+}
+
+#endif /* NOQLOG */
+
 #endif /* NGTCP2_QLOG_H */
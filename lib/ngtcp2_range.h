@@ -51,10 +51,16 @@ void ngtcp2_range_init(ngtcp2_range *r, uint64_t begin, uint64_t end);
 ngtcp2_range ngtcp2_range_intersect(const ngtcp2_range *a,
                                     const ngtcp2_range *b);
 
+#ifndef NOINLINEHELPERS
 /*
  * ngtcp2_range_len returns the length of |r|.
  */
+static inline uint64_t ngtcp2_range_len(const ngtcp2_range *r) {
+  return r->end - r->begin;
+}
+#else /* NOINLINEHELPERS */
 uint64_t ngtcp2_range_len(const ngtcp2_range *r);
+#endif /* NOINLINEHELPERS */
 
 /*
  * ngtcp2_range_eq returns nonzero if |a| equals |b|, such that
@@ -37,4 +37,14 @@
 /* NGTCP2_GRANULARITY is kGranularity described in RFC 9002. */
 #define NGTCP2_GRANULARITY NGTCP2_MILLISECONDS
 
+/* NGTCP2_MAX_PKT_THRESHOLD is the upper bound of the packet
+   threshold which grows with the number of packets in flight and the
+   observed reordering. */
+#define NGTCP2_MAX_PKT_THRESHOLD 256
+
+/* NGTCP2_REO_WND_PERSIST is the number of loss recoveries after which
+   the reordering window learned from spurious losses is reset.  It
+   is the same value that RACK (RFC 8985) uses. */
+#define NGTCP2_REO_WND_PERSIST 16
+
 #endif /* NGTCP2_RCVRY_H */
@@ -0,0 +1,247 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_relay.h"
+
+#include <string.h>
+#include <assert.h>
+
+#include "ngtcp2_macro.h"
+
+int ngtcp2_relay_new(ngtcp2_relay **prelay, ngtcp2_conn *down,
+                     int64_t down_stream_id, ngtcp2_conn *up,
+                     int64_t up_stream_id,
+                     const ngtcp2_relay_callbacks *callbacks, void *user_data,
+                     const ngtcp2_mem *mem) {
+  ngtcp2_relay *relay;
+
+  if (callbacks && callbacks->ref_rxbuf && !callbacks->unref_rxbuf) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  if (mem == NULL) {
+    mem = ngtcp2_mem_default();
+  }
+
+  relay = ngtcp2_mem_calloc(mem, 1, sizeof(*relay));
+  if (relay == NULL) {
+    return NGTCP2_ERR_NOMEM;
+  }
+
+  relay->down = down;
+  relay->up = up;
+  relay->down_stream_id = down_stream_id;
+  relay->up_stream_id = up_stream_id;
+  if (callbacks) {
+    relay->callbacks = *callbacks;
+  }
+  relay->user_data = user_data;
+  relay->mem = mem;
+
+  *prelay = relay;
+
+  return 0;
+}
+
+static void relay_entry_del(ngtcp2_relay *relay, ngtcp2_relay_entry *ent) {
+  if (ent->rxbuf) {
+    relay->callbacks.unref_rxbuf(relay, ent->rxbuf, relay->user_data);
+  }
+
+  ngtcp2_mem_free(relay->mem, ent);
+}
+
+void ngtcp2_relay_del(ngtcp2_relay *relay) {
+  ngtcp2_relay_entry *ent, *next;
+
+  if (relay == NULL) {
+    return;
+  }
+
+  for (ent = relay->head; ent; ent = next) {
+    next = ent->next;
+    relay_entry_del(relay, ent);
+  }
+
+  ngtcp2_mem_free(relay->mem, relay);
+}
+
+int ngtcp2_relay_recv_stream_data(ngtcp2_relay *relay, uint32_t flags,
+                                  uint64_t offset, const uint8_t *data,
+                                  size_t datalen, void *rxbuf) {
+  ngtcp2_relay_entry *ent;
+  int rv;
+
+  if (flags & NGTCP2_STREAM_DATA_FLAG_FIN) {
+    relay->fin = 1;
+  }
+
+  if (datalen == 0) {
+    return 0;
+  }
+
+  if ((flags & NGTCP2_STREAM_DATA_FLAG_IN_PLACE) && rxbuf &&
+      relay->callbacks.ref_rxbuf) {
+    ent = ngtcp2_mem_malloc(relay->mem, sizeof(*ent));
+    if (ent == NULL) {
+      return NGTCP2_ERR_NOMEM;
+    }
+
+    ent->data = data;
+    ent->rxbuf = rxbuf;
+  } else {
+    ent = ngtcp2_mem_malloc(relay->mem, sizeof(*ent) + datalen);
+    if (ent == NULL) {
+      return NGTCP2_ERR_NOMEM;
+    }
+
+    memcpy(ent + 1, data, datalen);
+
+    ent->data = (const uint8_t *)(ent + 1);
+    ent->rxbuf = NULL;
+  }
+
+  ent->next = NULL;
+  ent->datalen = datalen;
+  ent->released = 0;
+
+  rv = ngtcp2_conn_attach_stream_buf(relay->up, relay->up_stream_id, datalen,
+                                     ent);
+  if (rv != 0) {
+    ngtcp2_mem_free(relay->mem, ent);
+    return rv;
+  }
+
+  if (ent->rxbuf) {
+    relay->callbacks.ref_rxbuf(relay, rxbuf, relay->user_data);
+  }
+
+  if (relay->tail) {
+    relay->tail->next = ent;
+  } else {
+    relay->head = ent;
+  }
+
+  relay->tail = ent;
+
+  if (relay->pending == NULL) {
+    relay->pending = ent;
+    relay->pending_offset = 0;
+  }
+
+  if ((flags & NGTCP2_STREAM_DATA_FLAG_LOANED) && relay->down) {
+    ngtcp2_conn_release_stream_data(relay->down, relay->down_stream_id,
+                                    offset + datalen);
+  }
+
+  return 0;
+}
+
+size_t ngtcp2_relay_get_stream_data(ngtcp2_relay *relay, ngtcp2_vec *datav,
+                                    size_t datavcnt, int *pfin) {
+  ngtcp2_relay_entry *ent = relay->pending;
+  size_t offset = relay->pending_offset;
+  size_t i;
+
+  for (i = 0; i < datavcnt && ent; ++i, ent = ent->next, offset = 0) {
+    datav[i].base = (uint8_t *)ent->data + offset;
+    datav[i].len = ent->datalen - offset;
+  }
+
+  *pfin = ent == NULL && relay->fin && !relay->fin_written;
+
+  return i;
+}
+
+void ngtcp2_relay_add_write_offset(ngtcp2_relay *relay, uint64_t n) {
+  ngtcp2_relay_entry *ent;
+  size_t left;
+
+  for (; n;) {
+    ent = relay->pending;
+
+    assert(ent);
+
+    left = ent->datalen - relay->pending_offset;
+
+    if (n < left) {
+      relay->pending_offset += (size_t)n;
+      return;
+    }
+
+    n -= left;
+    relay->pending = ent->next;
+    relay->pending_offset = 0;
+  }
+
+  if (relay->pending == NULL && relay->fin) {
+    relay->fin_written = 1;
+  }
+}
+
+int ngtcp2_relay_release_stream_buf(ngtcp2_relay *relay,
+                                    void *buf_user_data) {
+  ngtcp2_relay_entry *ent = buf_user_data;
+  uint64_t datalen = 0;
+  int rv = 0;
+
+  ent->released = 1;
+
+  for (; relay->head && relay->head->released;) {
+    ent = relay->head;
+    relay->head = ent->next;
+
+    /* The upstream releases the entries which have not been written
+       if the stream is closed. */
+    if (relay->pending == ent) {
+      relay->pending = ent->next;
+      relay->pending_offset = 0;
+    }
+
+    datalen += ent->datalen;
+
+    relay_entry_del(relay, ent);
+  }
+
+  if (relay->head == NULL) {
+    relay->tail = NULL;
+  }
+
+  if (datalen == 0 || relay->down == NULL) {
+    return 0;
+  }
+
+  /* Give the downstream the credit for the data that the upstream
+     no longer needs, so that the data in flight on both connections
+     is bounded by the downstream window. */
+  rv = ngtcp2_conn_extend_max_stream_offset(relay->down, relay->down_stream_id,
+                                            datalen);
+  ngtcp2_conn_extend_max_offset(relay->down, datalen);
+
+  return rv;
+}
+
+void ngtcp2_relay_detach_downstream(ngtcp2_relay *relay) {
+  relay->down = NULL;
+}
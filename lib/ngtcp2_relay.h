@@ -0,0 +1,82 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGTCP2_RELAY_H
+#define NGTCP2_RELAY_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <ngtcp2/ngtcp2.h>
+
+#include "ngtcp2_mem.h"
+
+/*
+ * ngtcp2_relay_entry is a chunk of the stream data which a relay
+ * forwards.  It is attached to the upstream stream by
+ * ngtcp2_conn_attach_stream_buf, and freed when the upstream releases
+ * it.
+ */
+typedef struct ngtcp2_relay_entry ngtcp2_relay_entry;
+
+struct ngtcp2_relay_entry {
+  ngtcp2_relay_entry *next;
+  /* data points to the stream data.  It points into rxbuf if rxbuf is
+     not NULL, or the memory which follows this object otherwise. */
+  const uint8_t *data;
+  size_t datalen;
+  void *rxbuf;
+  /* released is nonzero if the upstream has released this entry. */
+  int released;
+};
+
+struct ngtcp2_relay {
+  /* down is the downstream connection.  It is NULL after
+     ngtcp2_relay_detach_downstream is called. */
+  ngtcp2_conn *down;
+  ngtcp2_conn *up;
+  int64_t down_stream_id;
+  int64_t up_stream_id;
+  /* head and tail are the entries which the upstream has not released
+     yet in the order of stream offset. */
+  ngtcp2_relay_entry *head;
+  ngtcp2_relay_entry *tail;
+  /* pending is the first entry which has the data not passed to
+     ngtcp2_conn_writev_stream yet, and pending_offset is the number
+     of bytes in it which have been passed. */
+  ngtcp2_relay_entry *pending;
+  size_t pending_offset;
+  /* fin is nonzero if the downstream has received the end of the
+     stream. */
+  int fin;
+  /* fin_written is nonzero if the end of the stream has been passed
+     to ngtcp2_conn_writev_stream. */
+  int fin_written;
+  ngtcp2_relay_callbacks callbacks;
+  void *user_data;
+  const ngtcp2_mem *mem;
+};
+
+#endif /* NGTCP2_RELAY_H */
@@ -25,6 +25,7 @@
 #include "ngtcp2_ringbuf.h"
 
 #include <assert.h>
+#include <string.h>
 #ifdef WIN32
 #  include <intrin.h>
 #endif
@@ -106,15 +107,46 @@ void ngtcp2_ringbuf_pop_back(ngtcp2_ringbuf *rb) {
   --rb->len;
 }
 
+int ngtcp2_ringbuf_reserve(ngtcp2_ringbuf *rb, size_t nmemb) {
+  uint8_t *buf;
+  size_t n, len = rb->len;
+
+  assert(nmemb >= rb->nmemb);
+
+  if (nmemb == rb->nmemb) {
+    return 0;
+  }
+
+  buf = ngtcp2_mem_malloc(rb->mem, nmemb * rb->size);
+  if (buf == NULL) {
+    return NGTCP2_ERR_NOMEM;
+  }
+
+  if (len) {
+    n = ngtcp2_min(len, rb->nmemb - rb->first);
+    memcpy(buf, &rb->buf[rb->first * rb->size], n * rb->size);
+    memcpy(buf + n * rb->size, rb->buf, (len - n) * rb->size);
+  }
+
+  ngtcp2_mem_free(rb->mem, rb->buf);
+
+  ngtcp2_ringbuf_buf_init(rb, nmemb, rb->size, buf, rb->mem);
+  rb->len = len;
+
+  return 0;
+}
+
 void ngtcp2_ringbuf_resize(ngtcp2_ringbuf *rb, size_t len) {
   assert(len <= rb->nmemb);
   rb->len = len;
 }
 
+#ifdef NOINLINEHELPERS
 void *ngtcp2_ringbuf_get(ngtcp2_ringbuf *rb, size_t offset) {
   assert(offset < rb->len);
   offset = (rb->first + offset) & (rb->nmemb - 1);
   return &rb->buf[offset * rb->size];
 }
+#endif /* NOINLINEHELPERS */
 
 int ngtcp2_ringbuf_full(ngtcp2_ringbuf *rb) { return rb->len == rb->nmemb; }
@@ -29,6 +29,8 @@
 #  include <config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <assert.h>
+
 #include <ngtcp2/ngtcp2.h>
 
 #include "ngtcp2_mem.h"
@@ -100,13 +102,35 @@ void ngtcp2_ringbuf_pop_front(ngtcp2_ringbuf *rb);
  */
 void ngtcp2_ringbuf_pop_back(ngtcp2_ringbuf *rb);
 
+/*
+ * ngtcp2_ringbuf_reserve extends the capacity of |rb| to |nmemb|
+ * elements, keeping the elements stored.  |nmemb| must be power of 2,
+ * and must not be less than the current capacity.  |rb| must have
+ * been initialized with ngtcp2_ringbuf_init.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ */
+int ngtcp2_ringbuf_reserve(ngtcp2_ringbuf *rb, size_t nmemb);
+
 /* ngtcp2_ringbuf_resize changes the number of elements stored.  This
    does not change the capacity of the underlying buffer. */
 void ngtcp2_ringbuf_resize(ngtcp2_ringbuf *rb, size_t len);
 
+#ifndef NOINLINEHELPERS
 /* ngtcp2_ringbuf_get returns the pointer to the element at
    |offset|. */
+static inline void *ngtcp2_ringbuf_get(ngtcp2_ringbuf *rb, size_t offset) {
+  assert(offset < rb->len);
+  offset = (rb->first + offset) & (rb->nmemb - 1);
+  return &rb->buf[offset * rb->size];
+}
+#else /* NOINLINEHELPERS */
 void *ngtcp2_ringbuf_get(ngtcp2_ringbuf *rb, size_t offset);
+#endif /* NOINLINEHELPERS */
 
 /* ngtcp2_ringbuf_len returns the number of elements stored. */
 #define ngtcp2_ringbuf_len(RB) ((RB)->len)
@@ -28,6 +28,7 @@
 #include <assert.h>
 
 #include "ngtcp2_macro.h"
+#include "ngtcp2_mem.h"
 
 int ngtcp2_rob_gap_new(ngtcp2_rob_gap **pg, uint64_t begin, uint64_t end,
                        const ngtcp2_mem *mem) {
@@ -57,6 +58,7 @@ int ngtcp2_rob_data_new(ngtcp2_rob_data **pd, uint64_t offset, size_t chunk,
   (*pd)->range.end = offset + chunk;
   (*pd)->begin = (uint8_t *)(*pd) + sizeof(ngtcp2_rob_data);
   (*pd)->end = (*pd)->begin + chunk;
+  (*pd)->next = NULL;
 
   return 0;
 }
@@ -65,44 +67,190 @@ void ngtcp2_rob_data_del(ngtcp2_rob_data *d, const ngtcp2_mem *mem) {
   ngtcp2_mem_free(mem, d);
 }
 
+/*
+ * rob_gap_new is similar to ngtcp2_rob_gap_new, but it reuses a gap
+ * in rob->gap_cache if any.
+ */
+static int rob_gap_new(ngtcp2_rob *rob, ngtcp2_rob_gap **pg, uint64_t begin,
+                       uint64_t end) {
+  ngtcp2_opl_entry *oplent = ngtcp2_opl_pop(&rob->gap_cache);
+
+  if (oplent == NULL) {
+    return ngtcp2_rob_gap_new(pg, begin, end, rob->mem);
+  }
+
+  --rob->ngap_cache;
+
+  *pg = ngtcp2_struct_of(oplent, ngtcp2_rob_gap, oplent);
+  (*pg)->range.begin = begin;
+  (*pg)->range.end = end;
+
+  return 0;
+}
+
+/*
+ * rob_gap_del keeps |g| in rob->gap_cache, or deletes it if the
+ * cache is full.
+ */
+static void rob_gap_del(ngtcp2_rob *rob, ngtcp2_rob_gap *g) {
+  if (rob->ngap_cache == NGTCP2_ROB_MAX_CACHED_GAP) {
+    ngtcp2_rob_gap_del(g, rob->mem);
+    return;
+  }
+
+  ngtcp2_opl_push(&rob->gap_cache, &g->oplent);
+  ++rob->ngap_cache;
+}
+
+/*
+ * rob_data_new is similar to ngtcp2_rob_data_new, but it reuses a
+ * buffer in rob->data_cache which is large enough to hold |len|
+ * bytes if any.
+ */
+static int rob_data_new(ngtcp2_rob *rob, ngtcp2_rob_data **pd, uint64_t offset,
+                        size_t len) {
+  ngtcp2_rob_data **pp, *d;
+
+  for (pp = &rob->data_cache; *pp; pp = &(*pp)->next) {
+    d = *pp;
+
+    if ((size_t)(d->end - d->begin) < len) {
+      continue;
+    }
+
+    *pp = d->next;
+    --rob->ndata_cache;
+
+    d->range.begin = offset;
+    d->range.end = offset + len;
+    d->next = NULL;
+
+    *pd = d;
+
+    return 0;
+  }
+
+  return ngtcp2_rob_data_new(pd, offset, len, rob->mem);
+}
+
+/*
+ * rob_data_del keeps |d| in rob->data_cache.  If the cache is full,
+ * the smallest buffer among |d| and the cached ones is deleted, so
+ * that the cache holds the buffers which can be reused for the most
+ * data.
+ */
+static void rob_data_del(ngtcp2_rob *rob, ngtcp2_rob_data *d) {
+  ngtcp2_rob_data **pp, **psmallest;
+
+  if (rob->ndata_cache == NGTCP2_ROB_MAX_CACHED_DATA) {
+    psmallest = &rob->data_cache;
+
+    for (pp = &rob->data_cache; *pp; pp = &(*pp)->next) {
+      if ((*pp)->end - (*pp)->begin < (*psmallest)->end - (*psmallest)->begin) {
+        psmallest = pp;
+      }
+    }
+
+    if ((*psmallest)->end - (*psmallest)->begin >= d->end - d->begin) {
+      ngtcp2_rob_data_del(d, rob->mem);
+      return;
+    }
+
+    d->next = (*psmallest)->next;
+    ngtcp2_rob_data_del(*psmallest, rob->mem);
+    *psmallest = d;
+
+    return;
+  }
+
+  d->next = rob->data_cache;
+  rob->data_cache = d;
+  ++rob->ndata_cache;
+}
+
+/*
+ * rob_free_cache frees the gaps and buffers kept for reuse.
+ */
+static void rob_free_cache(ngtcp2_rob *rob) {
+  ngtcp2_opl_entry *oplent;
+  ngtcp2_rob_data *d;
+
+  for (; (oplent = ngtcp2_opl_pop(&rob->gap_cache)) != NULL;) {
+    ngtcp2_rob_gap_del(ngtcp2_struct_of(oplent, ngtcp2_rob_gap, oplent),
+                       rob->mem);
+  }
+
+  rob->ngap_cache = 0;
+
+  for (; rob->data_cache;) {
+    d = rob->data_cache;
+    rob->data_cache = d->next;
+    ngtcp2_rob_data_del(d, rob->mem);
+  }
+
+  rob->ndata_cache = 0;
+}
+
 int ngtcp2_rob_init(ngtcp2_rob *rob, size_t chunk, const ngtcp2_mem *mem) {
   int rv;
-  ngtcp2_rob_gap *g;
+
+  mem = ngtcp2_mem_for_subsys(mem, NGTCP2_MEM_SUBSYS_ROB);
+
+  ngtcp2_opl_init(&rob->gap_cache);
+  rob->ngap_cache = 0;
+  rob->data_cache = NULL;
+  rob->ndata_cache = 0;
 
   ngtcp2_ksl_init(&rob->gapksl, ngtcp2_ksl_range_compar, sizeof(ngtcp2_range),
                   mem);
+  ngtcp2_ksl_init(&rob->dataksl, ngtcp2_ksl_range_compar, sizeof(ngtcp2_range),
+                  mem);
+
+  rob->mem = mem;
 
-  rv = ngtcp2_rob_gap_new(&g, 0, UINT64_MAX, mem);
+  rv = ngtcp2_rob_reinit(rob, chunk);
   if (rv != 0) {
-    goto fail_rob_gap_new;
+    ngtcp2_ksl_free(&rob->dataksl);
+    ngtcp2_ksl_free(&rob->gapksl);
+    return rv;
   }
 
-  rv = ngtcp2_ksl_insert(&rob->gapksl, NULL, &g->range, g);
+  return 0;
+}
+
+int ngtcp2_rob_reinit(ngtcp2_rob *rob, size_t chunk) {
+  int rv;
+  ngtcp2_rob_gap *g;
+
+  assert(0 == ngtcp2_ksl_len(&rob->gapksl));
+  assert(0 == ngtcp2_ksl_len(&rob->dataksl));
+
+  rv = rob_gap_new(rob, &g, 0, UINT64_MAX);
   if (rv != 0) {
-    goto fail_gapksl_ksl_insert;
+    return rv;
   }
 
-  ngtcp2_ksl_init(&rob->dataksl, ngtcp2_ksl_range_compar, sizeof(ngtcp2_range),
-                  mem);
+  rv = ngtcp2_ksl_insert(&rob->gapksl, NULL, &g->range, g);
+  if (rv != 0) {
+    rob_gap_del(rob, g);
+    return rv;
+  }
 
   rob->chunk = chunk;
-  rob->mem = mem;
+  rob->loaned = NULL;
+  rob->loaned_tail = &rob->loaned;
+  rob->released_offset = 0;
 
   return 0;
-
-fail_gapksl_ksl_insert:
-  ngtcp2_rob_gap_del(g, mem);
-fail_rob_gap_new:
-  ngtcp2_ksl_free(&rob->gapksl);
-  return rv;
 }
 
-void ngtcp2_rob_free(ngtcp2_rob *rob) {
+/*
+ * rob_del_all frees all buffered data and gaps in |rob|.
+ */
+static void rob_del_all(ngtcp2_rob *rob) {
   ngtcp2_ksl_it it;
 
-  if (rob == NULL) {
-    return;
-  }
+  ngtcp2_rob_release(rob, UINT64_MAX);
 
   for (it = ngtcp2_ksl_begin(&rob->dataksl); !ngtcp2_ksl_it_end(&it);
        ngtcp2_ksl_it_next(&it)) {
@@ -114,10 +262,90 @@ void ngtcp2_rob_free(ngtcp2_rob *rob) {
     ngtcp2_rob_gap_del(ngtcp2_ksl_it_get(&it), rob->mem);
   }
 
+  rob_free_cache(rob);
+}
+
+void ngtcp2_rob_free(ngtcp2_rob *rob) {
+  if (rob == NULL) {
+    return;
+  }
+
+  rob_del_all(rob);
+
   ngtcp2_ksl_free(&rob->dataksl);
   ngtcp2_ksl_free(&rob->gapksl);
 }
 
+void ngtcp2_rob_clear(ngtcp2_rob *rob) {
+  rob_del_all(rob);
+
+  ngtcp2_ksl_reset(&rob->dataksl);
+  ngtcp2_ksl_reset(&rob->gapksl);
+}
+
+/*
+ * rob_data_range returns the range of the buffer which should be
+ * allocated to store the data at |offset| of length |len|.  |it|
+ * points to the first buffer which ends after |offset|, and the
+ * buffer must start after |offset|.
+ *
+ * A buffer never crosses the boundary of rob->chunk, and it never
+ * overlaps the neighboring buffers.  If the data is isolated from the
+ * buffered data, the buffer is just large enough to hold it in the
+ * multiple of NGTCP2_ROB_CHUNK_GRANULE bytes, so that tiny out of
+ * order fragments do not pin full chunks.  If the data starts right
+ * after the preceding buffer, it is likely that more data follows,
+ * and the buffer extends to the end of the chunk.
+ */
+static ngtcp2_range rob_data_range(ngtcp2_rob *rob, const ngtcp2_ksl_it *it,
+                                   uint64_t offset, size_t len) {
+  uint64_t chunk_begin = offset / rob->chunk * rob->chunk;
+  uint64_t end;
+  ngtcp2_range r;
+  ngtcp2_ksl_it pit;
+  ngtcp2_rob_data *d;
+  int isolated = 1;
+
+  r.begin = offset / NGTCP2_ROB_CHUNK_GRANULE * NGTCP2_ROB_CHUNK_GRANULE;
+  if (r.begin < chunk_begin) {
+    r.begin = chunk_begin;
+  }
+  r.end = chunk_begin + rob->chunk;
+
+  if (ngtcp2_ksl_len(&rob->dataksl)) {
+    if (!ngtcp2_ksl_it_begin(it)) {
+      pit = *it;
+      ngtcp2_ksl_it_prev(&pit);
+      d = ngtcp2_ksl_it_get(&pit);
+
+      assert(d->range.end <= offset);
+
+      if (d->range.end > r.begin) {
+        r.begin = d->range.end;
+      }
+
+      isolated = d->range.end != offset;
+    }
+
+    if (!ngtcp2_ksl_it_end(it)) {
+      d = ngtcp2_ksl_it_get(it);
+      if (d->range.begin < r.end) {
+        r.end = d->range.begin;
+      }
+    }
+  }
+
+  if (isolated) {
+    end = (offset + len + NGTCP2_ROB_CHUNK_GRANULE - 1) /
+          NGTCP2_ROB_CHUNK_GRANULE * NGTCP2_ROB_CHUNK_GRANULE;
+    if (end < r.end) {
+      r.end = end;
+    }
+  }
+
+  return r;
+}
+
 static int rob_write_data(ngtcp2_rob *rob, uint64_t offset, const uint8_t *data,
                           size_t len) {
   size_t n;
@@ -136,20 +364,22 @@ static int rob_write_data(ngtcp2_rob *rob, uint64_t offset, const uint8_t *data,
     }
 
     if (d == NULL || offset < d->range.begin) {
-      rv = ngtcp2_rob_data_new(&d, (offset / rob->chunk) * rob->chunk,
-                               rob->chunk, rob->mem);
+      range = rob_data_range(rob, &it, offset, len);
+
+      rv = rob_data_new(rob, &d, range.begin,
+                        (size_t)ngtcp2_range_len(&range));
       if (rv != 0) {
         return rv;
       }
 
       rv = ngtcp2_ksl_insert(&rob->dataksl, &it, &d->range, d);
       if (rv != 0) {
-        ngtcp2_rob_data_del(d, rob->mem);
+        rob_data_del(rob, d);
         return rv;
       }
     }
 
-    n = (size_t)ngtcp2_min((uint64_t)len, d->range.begin + rob->chunk - offset);
+    n = (size_t)ngtcp2_min((uint64_t)len, d->range.end - offset);
     memcpy(d->begin + (offset - d->range.begin), data, n);
     offset += n;
     data += n;
@@ -178,7 +408,7 @@ int ngtcp2_rob_push(ngtcp2_rob *rob, uint64_t offset, const uint8_t *data,
     }
     if (ngtcp2_range_eq(&g->range, &m)) {
       ngtcp2_ksl_remove_hint(&rob->gapksl, &it, &it, &g->range);
-      ngtcp2_rob_gap_del(g, rob->mem);
+      rob_gap_del(rob, g);
       rv = rob_write_data(rob, m.begin, data + (m.begin - offset),
                           (size_t)ngtcp2_range_len(&m));
       if (rv != 0) {
@@ -194,13 +424,13 @@ int ngtcp2_rob_push(ngtcp2_rob *rob, uint64_t offset, const uint8_t *data,
 
       if (ngtcp2_range_len(&r)) {
         ngtcp2_rob_gap *ng;
-        rv = ngtcp2_rob_gap_new(&ng, r.begin, r.end, rob->mem);
+        rv = rob_gap_new(rob, &ng, r.begin, r.end);
         if (rv != 0) {
           return rv;
         }
         rv = ngtcp2_ksl_insert(&rob->gapksl, &it, &ng->range, ng);
         if (rv != 0) {
-          ngtcp2_rob_gap_del(ng, rob->mem);
+          rob_gap_del(rob, ng);
           return rv;
         }
       }
@@ -237,18 +467,18 @@ int ngtcp2_rob_remove_prefix(ngtcp2_rob *rob, uint64_t offset) {
       break;
     }
     ngtcp2_ksl_remove_hint(&rob->gapksl, &it, &it, &g->range);
-    ngtcp2_rob_gap_del(g, rob->mem);
+    rob_gap_del(rob, g);
   }
 
   it = ngtcp2_ksl_begin(&rob->dataksl);
 
   for (; !ngtcp2_ksl_it_end(&it);) {
     d = ngtcp2_ksl_it_get(&it);
-    if (offset < d->range.begin + rob->chunk) {
+    if (offset < d->range.end) {
       return 0;
     }
     ngtcp2_ksl_remove_hint(&rob->dataksl, &it, &it, &d->range);
-    ngtcp2_rob_data_del(d, rob->mem);
+    rob_data_del(rob, d);
   }
 
   return 0;
@@ -276,12 +506,11 @@ size_t ngtcp2_rob_data_at(ngtcp2_rob *rob, const uint8_t **pdest,
 
   assert(d);
   assert(d->range.begin <= offset);
-  assert(offset < d->range.begin + rob->chunk);
+  assert(offset < d->range.end);
 
   *pdest = d->begin + (offset - d->range.begin);
 
-  return (size_t)(ngtcp2_min(g->range.begin, d->range.begin + rob->chunk) -
-                  offset);
+  return (size_t)(ngtcp2_min(g->range.begin, d->range.end) - offset);
 }
 
 void ngtcp2_rob_pop(ngtcp2_rob *rob, uint64_t offset, size_t len) {
@@ -293,12 +522,54 @@ void ngtcp2_rob_pop(ngtcp2_rob *rob, uint64_t offset, size_t len) {
 
   assert(d);
 
-  if (offset + len < d->range.begin + rob->chunk) {
+  if (offset + len < d->range.end) {
     return;
   }
 
   ngtcp2_ksl_remove_hint(&rob->dataksl, NULL, &it, &d->range);
-  ngtcp2_rob_data_del(d, rob->mem);
+  rob_data_del(rob, d);
+}
+
+void ngtcp2_rob_loan(ngtcp2_rob *rob, uint64_t offset, size_t len) {
+  ngtcp2_ksl_it it;
+  ngtcp2_rob_data *d;
+
+  it = ngtcp2_ksl_begin(&rob->dataksl);
+  d = ngtcp2_ksl_it_get(&it);
+
+  assert(d);
+
+  if (offset + len < d->range.end) {
+    return;
+  }
+
+  ngtcp2_ksl_remove_hint(&rob->dataksl, NULL, &it, &d->range);
+
+  if (d->range.end <= rob->released_offset) {
+    rob_data_del(rob, d);
+    return;
+  }
+
+  *rob->loaned_tail = d;
+  rob->loaned_tail = &d->next;
+}
+
+void ngtcp2_rob_release(ngtcp2_rob *rob, uint64_t offset) {
+  ngtcp2_rob_data *d;
+
+  if (rob->released_offset < offset) {
+    rob->released_offset = offset;
+  }
+
+  for (; rob->loaned && rob->loaned->range.end <= offset;) {
+    d = rob->loaned;
+    rob->loaned = d->next;
+    rob_data_del(rob, d);
+  }
+
+  if (rob->loaned == NULL) {
+    rob->loaned_tail = &rob->loaned;
+  }
 }
 
 uint64_t ngtcp2_rob_first_gap_offset(ngtcp2_rob *rob) {
@@ -314,6 +585,24 @@ uint64_t ngtcp2_rob_first_gap_offset(ngtcp2_rob *rob) {
   return g->range.begin;
 }
 
+int ngtcp2_rob_is_received(ngtcp2_rob *rob, uint64_t offset, uint64_t len) {
+  ngtcp2_range q = {offset, offset + len};
+  ngtcp2_ksl_it it;
+  ngtcp2_rob_gap *g;
+  ngtcp2_range m;
+
+  it = ngtcp2_ksl_lower_bound_compar(&rob->gapksl, &q,
+                                     ngtcp2_ksl_range_exclusive_compar);
+  if (ngtcp2_ksl_it_end(&it)) {
+    return 1;
+  }
+
+  g = ngtcp2_ksl_it_get(&it);
+  m = ngtcp2_range_intersect(&q, &g->range);
+
+  return ngtcp2_range_len(&m) == 0;
+}
+
 int ngtcp2_rob_data_buffered(ngtcp2_rob *rob) {
   return ngtcp2_ksl_len(&rob->dataksl) != 0;
 }
@@ -34,14 +34,21 @@
 #include "ngtcp2_mem.h"
 #include "ngtcp2_range.h"
 #include "ngtcp2_ksl.h"
+#include "ngtcp2_opl.h"
 
 /*
  * ngtcp2_rob_gap represents the gap, which is the range of stream
  * data that is not received yet.
  */
 typedef struct ngtcp2_rob_gap {
-  /* range is the range of this gap. */
-  ngtcp2_range range;
+  union {
+    struct {
+      /* range is the range of this gap. */
+      ngtcp2_range range;
+    };
+
+    ngtcp2_opl_entry oplent;
+  };
 } ngtcp2_rob_gap;
 
 /*
@@ -66,6 +73,12 @@ int ngtcp2_rob_gap_new(ngtcp2_rob_gap **pg, uint64_t begin, uint64_t end,
  */
 void ngtcp2_rob_gap_del(ngtcp2_rob_gap *g, const ngtcp2_mem *mem);
 
+/*
+ * NGTCP2_ROB_CHUNK_GRANULE is the unit of the buffer size allocated
+ * for an isolated out of order fragment.
+ */
+#define NGTCP2_ROB_CHUNK_GRANULE 256
+
 /*
  * ngtcp2_rob_data holds the buffered stream data.
  */
@@ -74,8 +87,11 @@ typedef struct ngtcp2_rob_data {
   ngtcp2_range range;
   /* begin points to the buffer. */
   uint8_t *begin;
-  /* end points to the one beyond of the last byte of the buffer */
+  /* end points to the one beyond of the last byte of the buffer.
+     The buffer may be larger than range if it is reused. */
   uint8_t *end;
+  /* next points to the next buffer in ngtcp2_rob.loaned. */
+  struct ngtcp2_rob_data *next;
 } ngtcp2_rob_data;
 
 /*
@@ -83,8 +99,8 @@ typedef struct ngtcp2_rob_data {
  * assigns its pointer to |*pd|.  The caller should call
  * ngtcp2_rob_data_del to delete it when it is no longer used.
  * |offset| is the stream offset of the first byte of this data.
- * |chunk| is the size of the buffer.  |offset| must be multiple of
- * |chunk|.  |mem| is custom memory allocator to allocate memory.
+ * |chunk| is the size of the buffer.  |mem| is custom memory
+ * allocator to allocate memory.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -102,6 +118,18 @@ int ngtcp2_rob_data_new(ngtcp2_rob_data **pd, uint64_t offset, size_t chunk,
  */
 void ngtcp2_rob_data_del(ngtcp2_rob_data *d, const ngtcp2_mem *mem);
 
+/*
+ * NGTCP2_ROB_MAX_CACHED_GAP is the maximum number of released
+ * ngtcp2_rob_gap objects that ngtcp2_rob keeps for reuse.
+ */
+#define NGTCP2_ROB_MAX_CACHED_GAP 4
+
+/*
+ * NGTCP2_ROB_MAX_CACHED_DATA is the maximum number of released
+ * ngtcp2_rob_data objects that ngtcp2_rob keeps for reuse.
+ */
+#define NGTCP2_ROB_MAX_CACHED_DATA 4
+
 /*
  * ngtcp2_rob is the reorder buffer which reassembles stream data
  * received in out of order.
@@ -115,13 +143,37 @@ typedef struct ngtcp2_rob {
   ngtcp2_ksl dataksl;
   /* mem is custom memory allocator */
   const ngtcp2_mem *mem;
-  /* chunk is the size of each buffer in data field */
+  /* chunk is the maximum size of each buffer in data field.  A
+     buffer never crosses a multiple of chunk. */
   size_t chunk;
+  /* loaned is the list of buffers which are handed out by
+     ngtcp2_rob_loan, and are not released yet.  They are ordered by
+     stream offset. */
+  ngtcp2_rob_data *loaned;
+  /* loaned_tail points to the next field of the last buffer in
+     loaned, or loaned if it is empty. */
+  ngtcp2_rob_data **loaned_tail;
+  /* released_offset is the largest offset passed to
+     ngtcp2_rob_release. */
+  uint64_t released_offset;
+  /* gap_cache keeps at most NGTCP2_ROB_MAX_CACHED_GAP released gaps
+     so that a steady stream of out of order packets does not
+     allocate a gap for each of them.  ngap_cache is the number of
+     gaps in it. */
+  ngtcp2_opl gap_cache;
+  size_t ngap_cache;
+  /* data_cache is the list of at most NGTCP2_ROB_MAX_CACHED_DATA
+     released buffers chained by next field.  A buffer is reused for
+     the data that fits in it.  ndata_cache is the number of buffers
+     in it. */
+  ngtcp2_rob_data *data_cache;
+  size_t ndata_cache;
 } ngtcp2_rob;
 
 /*
- * ngtcp2_rob_init initializes |rob|.  |chunk| is the size of buffer
- * per chunk.
+ * ngtcp2_rob_init initializes |rob|.  |chunk| is the maximum size of
+ * buffer per chunk.  A buffer which holds an isolated out of order
+ * fragment is smaller than |chunk|.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -136,6 +188,25 @@ int ngtcp2_rob_init(ngtcp2_rob *rob, size_t chunk, const ngtcp2_mem *mem);
  */
 void ngtcp2_rob_free(ngtcp2_rob *rob);
 
+/*
+ * ngtcp2_rob_clear frees all data buffered in |rob|, but keeps the
+ * memory of its internal structures.  |rob| must be made usable again
+ * by ngtcp2_rob_reinit, or freed by ngtcp2_rob_free.
+ */
+void ngtcp2_rob_clear(ngtcp2_rob *rob);
+
+/*
+ * ngtcp2_rob_reinit makes |rob| cleared by ngtcp2_rob_clear usable
+ * again as if it is initialized by ngtcp2_rob_init with |chunk|.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ */
+int ngtcp2_rob_reinit(ngtcp2_rob *rob, size_t chunk);
+
 /*
  * ngtcp2_rob_push adds new data of length |datalen| at the stream
  * offset |offset|.
@@ -183,12 +254,34 @@ size_t ngtcp2_rob_data_at(ngtcp2_rob *rob, const uint8_t **pdest,
  */
 void ngtcp2_rob_pop(ngtcp2_rob *rob, uint64_t offset, size_t len);
 
+/*
+ * ngtcp2_rob_loan works like ngtcp2_rob_pop, but it does not free the
+ * buffer which becomes empty.  The buffer is kept until
+ * ngtcp2_rob_release releases the offset it ends at, so that the
+ * pointer obtained by ngtcp2_rob_data_at stays valid.
+ */
+void ngtcp2_rob_loan(ngtcp2_rob *rob, uint64_t offset, size_t len);
+
+/*
+ * ngtcp2_rob_release frees the buffers handed out by ngtcp2_rob_loan
+ * which end at or before |offset|.
+ */
+void ngtcp2_rob_release(ngtcp2_rob *rob, uint64_t offset);
+
 /*
  * ngtcp2_rob_first_gap_offset returns the offset to the first gap.
  * If there is no gap, it returns UINT64_MAX.
  */
 uint64_t ngtcp2_rob_first_gap_offset(ngtcp2_rob *rob);
 
+/*
+ * ngtcp2_rob_is_received returns nonzero if all data in the range
+ * [|offset|, |offset| + |len|) have been received.  The range must
+ * not precede the data which have been removed by
+ * ngtcp2_rob_remove_prefix.
+ */
+int ngtcp2_rob_is_received(ngtcp2_rob *rob, uint64_t offset, uint64_t len);
+
 /*
  * ngtcp2_rob_data_buffered returns nonzero if any data is buffered.
  */
@@ -72,7 +72,7 @@ void ngtcp2_rst_on_pkt_sent(ngtcp2_rst *rst, ngtcp2_rtb_entry *ent,
 int ngtcp2_rst_on_ack_recv(ngtcp2_rst *rst, ngtcp2_conn_stat *cstat,
                            uint64_t pkt_delivered) {
   ngtcp2_rs *rs = &rst->rs;
-  uint64_t rate;
+  uint64_t rate, best;
 
   if (rst->app_limited && rst->delivered > rst->app_limited) {
     rst->app_limited = 0;
@@ -101,9 +101,19 @@ int ngtcp2_rst_on_ack_recv(ngtcp2_rst *rst, ngtcp2_conn_stat *cstat,
     return 0;
   }
 
+  best = ngtcp2_window_filter_get_best(&rst->wf);
+
+  /* An application limited sample is only taken if it exceeds the
+     current best.  Compare them without division if the product
+     cannot overflow. */
+  if (rst->app_limited && rs->interval <= UINT32_MAX && best < UINT32_MAX &&
+      rs->delivered * NGTCP2_SECONDS < (best + 1) * rs->interval) {
+    return 0;
+  }
+
   rate = rs->delivered * NGTCP2_SECONDS / rs->interval;
 
-  if (rate > ngtcp2_window_filter_get_best(&rst->wf) || !rst->app_limited) {
+  if (rate > best || !rst->app_limited) {
     ngtcp2_window_filter_update(&rst->wf, rate, rst->round_count);
     cstat->delivery_rate_sec = ngtcp2_window_filter_get_best(&rst->wf);
   }
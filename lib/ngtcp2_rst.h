@@ -35,23 +35,10 @@
 
 typedef struct ngtcp2_rtb_entry ngtcp2_rtb_entry;
 
-/**
- * @struct
- *
- * ngtcp2_rs contains connection state for delivery rate estimation.
- */
-typedef struct ngtcp2_rs {
-  ngtcp2_duration interval;
-  uint64_t delivered;
-  uint64_t prior_delivered;
-  ngtcp2_tstamp prior_ts;
-  uint64_t tx_in_flight;
-  uint64_t lost;
-  uint64_t prior_lost;
-  ngtcp2_duration send_elapsed;
-  ngtcp2_duration ack_elapsed;
-  int is_app_limited;
-} ngtcp2_rs;
+/* ngtcp2_rs contains connection state for delivery rate estimation.
+   It is exposed to user congestion controller as
+   ngtcp2_rate_sample. */
+typedef ngtcp2_rate_sample ngtcp2_rs;
 
 void ngtcp2_rs_init(ngtcp2_rs *rs);
 
@@ -34,6 +34,7 @@
 #include "ngtcp2_cc.h"
 #include "ngtcp2_rcvry.h"
 #include "ngtcp2_rst.h"
+#include "ngtcp2_probe.h"
 
 int ngtcp2_frame_chain_new(ngtcp2_frame_chain **pfrc, const ngtcp2_mem *mem) {
   *pfrc = ngtcp2_mem_malloc(mem, sizeof(ngtcp2_frame_chain));
@@ -42,6 +43,7 @@ int ngtcp2_frame_chain_new(ngtcp2_frame_chain **pfrc, const ngtcp2_mem *mem) {
   }
 
   ngtcp2_frame_chain_init(*pfrc);
+  (*pfrc)->size_class = NGTCP2_FRAME_CHAIN_SIZE_CLASS_HEAP;
 
   return 0;
 }
@@ -66,42 +68,90 @@ int ngtcp2_frame_chain_extralen_new(ngtcp2_frame_chain **pfrc, size_t extralen,
   }
 
   ngtcp2_frame_chain_init(*pfrc);
+  (*pfrc)->size_class = NGTCP2_FRAME_CHAIN_SIZE_CLASS_HEAP;
 
   return 0;
 }
 
-int ngtcp2_frame_chain_stream_datacnt_objalloc_new(ngtcp2_frame_chain **pfrc,
-                                                   size_t datacnt,
-                                                   ngtcp2_objalloc *objalloc,
-                                                   const ngtcp2_mem *mem) {
-  size_t need, avail = sizeof(ngtcp2_frame) - sizeof(ngtcp2_stream);
+/*
+ * frame_chain_datacnt_extralen returns the number of bytes that
+ * ngtcp2_frame_chain needs after ngtcp2_frame to store |datacnt|
+ * ngtcp2_vec after the frame header of size |hdlen|.
+ */
+static size_t frame_chain_datacnt_extralen(size_t hdlen, size_t datacnt) {
+  size_t need, avail = sizeof(ngtcp2_frame) - hdlen;
+
+  if (datacnt <= 1) {
+    return 0;
+  }
+
+  need = sizeof(ngtcp2_vec) * (datacnt - 1);
+
+  return need > avail ? need - avail : 0;
+}
+
+/*
+ * frame_chain_size_class_extralen returns the number of extra bytes
+ * that a frame chain of |size_class| has after ngtcp2_frame.
+ */
+static size_t frame_chain_size_class_extralen(uint8_t size_class) {
+  assert(size_class == NGTCP2_FRAME_CHAIN_SIZE_CLASS_DATACNT4 ||
+         size_class == NGTCP2_FRAME_CHAIN_SIZE_CLASS_DATACNT8);
+
+  return frame_chain_datacnt_extralen(
+      sizeof(ngtcp2_stream),
+      size_class == NGTCP2_FRAME_CHAIN_SIZE_CLASS_DATACNT4 ? 4 : 8);
+}
+
+int ngtcp2_frame_chain_extralen_objalloc_new(ngtcp2_frame_chain **pfrc,
+                                             size_t extralen,
+                                             ngtcp2_objalloc *objalloc,
+                                             const ngtcp2_mem *mem) {
+  uint8_t size_class;
+  size_t class_extralen;
 
-  if (datacnt > 1) {
-    need = sizeof(ngtcp2_vec) * (datacnt - 1);
+  if (extralen == 0) {
+    return ngtcp2_frame_chain_objalloc_new(pfrc, objalloc);
+  }
+
+  for (size_class = NGTCP2_FRAME_CHAIN_SIZE_CLASS_DATACNT4;
+       size_class <= NGTCP2_FRAME_CHAIN_SIZE_CLASS_DATACNT8; ++size_class) {
+    class_extralen = frame_chain_size_class_extralen(size_class);
+    if (extralen > class_extralen) {
+      continue;
+    }
 
-    if (need > avail) {
-      return ngtcp2_frame_chain_extralen_new(pfrc, need - avail, mem);
+    *pfrc = ngtcp2_objalloc_frame_chain_sized_get(
+        objalloc, size_class - 1, sizeof(ngtcp2_frame_chain) + class_extralen);
+    if (*pfrc == NULL) {
+      return NGTCP2_ERR_NOMEM;
     }
+
+    ngtcp2_frame_chain_init(*pfrc);
+    (*pfrc)->size_class = size_class;
+
+    return 0;
   }
 
-  return ngtcp2_frame_chain_objalloc_new(pfrc, objalloc);
+  return ngtcp2_frame_chain_extralen_new(pfrc, extralen, mem);
 }
 
-int ngtcp2_frame_chain_crypto_datacnt_objalloc_new(ngtcp2_frame_chain **pfrc,
+int ngtcp2_frame_chain_stream_datacnt_objalloc_new(ngtcp2_frame_chain **pfrc,
                                                    size_t datacnt,
                                                    ngtcp2_objalloc *objalloc,
                                                    const ngtcp2_mem *mem) {
-  size_t need, avail = sizeof(ngtcp2_frame) - sizeof(ngtcp2_crypto);
-
-  if (datacnt > 1) {
-    need = sizeof(ngtcp2_vec) * (datacnt - 1);
-
-    if (need > avail) {
-      return ngtcp2_frame_chain_extralen_new(pfrc, need - avail, mem);
-    }
-  }
+  return ngtcp2_frame_chain_extralen_objalloc_new(
+      pfrc, frame_chain_datacnt_extralen(sizeof(ngtcp2_stream), datacnt),
+      objalloc, mem);
+}
 
-  return ngtcp2_frame_chain_objalloc_new(pfrc, objalloc);
+int ngtcp2_frame_chain_crypto_datacnt_objalloc_new(ngtcp2_frame_chain **pfrc,
+                                                   size_t datacnt,
+                                                   ngtcp2_objalloc *objalloc,
+                                                   const ngtcp2_mem *mem) {
+  return ngtcp2_frame_chain_extralen_objalloc_new(
+      pfrc, frame_chain_datacnt_extralen(sizeof(ngtcp2_crypto), datacnt),
+      objalloc, mem);
 }
 
 int ngtcp2_frame_chain_new_token_objalloc_new(ngtcp2_frame_chain **pfrc,
@@ -113,11 +163,8 @@ int ngtcp2_frame_chain_new_token_objalloc_new(ngtcp2_frame_chain **pfrc,
   uint8_t *p;
   ngtcp2_frame *fr;
 
-  if (token->len > avail) {
-    rv = ngtcp2_frame_chain_extralen_new(pfrc, token->len - avail, mem);
-  } else {
-    rv = ngtcp2_frame_chain_objalloc_new(pfrc, objalloc);
-  }
+  rv = ngtcp2_frame_chain_extralen_objalloc_new(
+      pfrc, token->len > avail ? token->len - avail : 0, objalloc, mem);
   if (rv != 0) {
     return rv;
   }
@@ -157,36 +204,10 @@ void ngtcp2_frame_chain_objalloc_del(ngtcp2_frame_chain *frc,
     return;
   }
 
-  switch (frc->fr.type) {
-  case NGTCP2_FRAME_STREAM:
-    if (frc->fr.stream.datacnt &&
-        sizeof(ngtcp2_vec) * (frc->fr.stream.datacnt - 1) >
-            sizeof(ngtcp2_frame) - sizeof(ngtcp2_stream)) {
-      ngtcp2_frame_chain_del(frc, mem);
-
-      return;
-    }
-
-    break;
-  case NGTCP2_FRAME_CRYPTO:
-    if (frc->fr.crypto.datacnt &&
-        sizeof(ngtcp2_vec) * (frc->fr.crypto.datacnt - 1) >
-            sizeof(ngtcp2_frame) - sizeof(ngtcp2_crypto)) {
-      ngtcp2_frame_chain_del(frc, mem);
+  if (frc->size_class == NGTCP2_FRAME_CHAIN_SIZE_CLASS_HEAP) {
+    ngtcp2_frame_chain_del(frc, mem);
 
-      return;
-    }
-
-    break;
-  case NGTCP2_FRAME_NEW_TOKEN:
-    if (frc->fr.new_token.token.len >
-        sizeof(ngtcp2_frame) - sizeof(ngtcp2_new_token)) {
-      ngtcp2_frame_chain_del(frc, mem);
-
-      return;
-    }
-
-    break;
+    return;
   }
 
   binder = frc->binder;
@@ -196,12 +217,19 @@ void ngtcp2_frame_chain_objalloc_del(ngtcp2_frame_chain *frc,
 
   frc->binder = NULL;
 
-  ngtcp2_objalloc_frame_chain_release(objalloc, frc);
+  if (frc->size_class == NGTCP2_FRAME_CHAIN_SIZE_CLASS_BASE) {
+    ngtcp2_objalloc_frame_chain_release(objalloc, frc);
+    return;
+  }
+
+  ngtcp2_objalloc_frame_chain_sized_release(objalloc,
+                                            (size_t)frc->size_class - 1, frc);
 }
 
 void ngtcp2_frame_chain_init(ngtcp2_frame_chain *frc) {
   frc->next = NULL;
   frc->binder = NULL;
+  frc->size_class = NGTCP2_FRAME_CHAIN_SIZE_CLASS_BASE;
 }
 
 void ngtcp2_frame_chain_list_objalloc_del(ngtcp2_frame_chain *frc,
@@ -216,6 +244,61 @@ void ngtcp2_frame_chain_list_objalloc_del(ngtcp2_frame_chain *frc,
   }
 }
 
+void ngtcp2_cryptofrq_init(ngtcp2_cryptofrq *frq) {
+  frq->head = frq->tail = NULL;
+  frq->len = 0;
+}
+
+void ngtcp2_cryptofrq_push(ngtcp2_cryptofrq *frq, ngtcp2_frame_chain *frc) {
+  uint64_t offset = frc->fr.crypto.offset;
+  ngtcp2_frame_chain **pfrc;
+
+  ++frq->len;
+
+  if (frq->tail == NULL || frq->tail->fr.crypto.offset <= offset) {
+    frc->next = NULL;
+
+    if (frq->tail) {
+      frq->tail->next = frc;
+    } else {
+      frq->head = frc;
+    }
+
+    frq->tail = frc;
+
+    return;
+  }
+
+  for (pfrc = &frq->head; (*pfrc)->fr.crypto.offset <= offset;
+       pfrc = &(*pfrc)->next)
+    ;
+
+  frc->next = *pfrc;
+  *pfrc = frc;
+}
+
+ngtcp2_frame_chain *ngtcp2_cryptofrq_pop(ngtcp2_cryptofrq *frq) {
+  ngtcp2_frame_chain *frc = frq->head;
+
+  assert(frc);
+
+  frq->head = frc->next;
+  if (frq->head == NULL) {
+    frq->tail = NULL;
+  }
+
+  frc->next = NULL;
+  --frq->len;
+
+  return frc;
+}
+
+void ngtcp2_cryptofrq_clear(ngtcp2_cryptofrq *frq, ngtcp2_objalloc *objalloc,
+                            const ngtcp2_mem *mem) {
+  ngtcp2_frame_chain_list_objalloc_del(frq->head, objalloc, mem);
+  ngtcp2_cryptofrq_init(frq);
+}
+
 int ngtcp2_frame_chain_binder_new(ngtcp2_frame_chain_binder **pbinder,
                                   const ngtcp2_mem *mem) {
   *pbinder = ngtcp2_mem_calloc(mem, 1, sizeof(ngtcp2_frame_chain_binder));
@@ -291,8 +374,11 @@ void ngtcp2_rtb_entry_objalloc_del(ngtcp2_rtb_entry *ent,
   ngtcp2_objalloc_rtb_entry_release(objalloc, ent);
 }
 
-static int greater(const ngtcp2_ksl_key *lhs, const ngtcp2_ksl_key *rhs) {
-  return *(int64_t *)lhs > *(int64_t *)rhs;
+static void rtb_reorder_reset(ngtcp2_rtb *rtb) {
+  rtb->reorder.pkt_thres = NGTCP2_PKT_THRESHOLD;
+  rtb->reorder.wnd_mult = 0;
+  rtb->reorder.wnd_persist = 0;
+  rtb->reorder.next_ts = 0;
 }
 
 void ngtcp2_rtb_init(ngtcp2_rtb *rtb, ngtcp2_pktns_id pktns_id,
@@ -302,7 +388,14 @@ void ngtcp2_rtb_init(ngtcp2_rtb *rtb, ngtcp2_pktns_id pktns_id,
                      ngtcp2_objalloc *frc_objalloc, const ngtcp2_mem *mem) {
   rtb->rtb_entry_objalloc = rtb_entry_objalloc;
   rtb->frc_objalloc = frc_objalloc;
-  ngtcp2_ksl_init(&rtb->ents, greater, sizeof(int64_t), mem);
+  rtb->ents.slots = NULL;
+  rtb->ents.cap = 0;
+  ngtcp2_ksl_init(&rtb->ents.sparse, ngtcp2_ksl_int64_greater,
+                  sizeof(int64_t), mem);
+  rtb->ents.base = 0;
+  rtb->ents.last = 0;
+  rtb->ents.len = 0;
+  rtb->ents.use_sparse = 0;
   rtb->crypto = crypto;
   rtb->rst = rst;
   rtb->cc = cc;
@@ -320,24 +413,391 @@ void ngtcp2_rtb_init(ngtcp2_rtb *rtb, ngtcp2_pktns_id pktns_id,
   rtb->persistent_congestion_start_ts = UINT64_MAX;
   rtb->num_lost_pkts = 0;
   rtb->num_lost_pmtud_pkts = 0;
+
+  rtb_reorder_reset(rtb);
 }
 
 void ngtcp2_rtb_free(ngtcp2_rtb *rtb) {
-  ngtcp2_ksl_it it;
+  ngtcp2_rtb_it it;
 
   if (rtb == NULL) {
     return;
   }
 
-  it = ngtcp2_ksl_begin(&rtb->ents);
+  it = ngtcp2_rtb_head(rtb);
 
-  for (; !ngtcp2_ksl_it_end(&it); ngtcp2_ksl_it_next(&it)) {
-    ngtcp2_rtb_entry_objalloc_del(ngtcp2_ksl_it_get(&it),
+  for (; !ngtcp2_rtb_it_end(&it); ngtcp2_rtb_it_next(&it)) {
+    ngtcp2_rtb_entry_objalloc_del(ngtcp2_rtb_it_get(&it),
                                   rtb->rtb_entry_objalloc, rtb->frc_objalloc,
                                   rtb->mem);
   }
 
-  ngtcp2_ksl_free(&rtb->ents);
+  ngtcp2_mem_free(rtb->mem, rtb->ents.slots);
+  ngtcp2_ksl_free(&rtb->ents.sparse);
+}
+
+static ngtcp2_rtb_entry **rtb_ents_slot(ngtcp2_rtb *rtb, int64_t pkt_num) {
+  return &rtb->ents.slots[(uint64_t)pkt_num & (rtb->ents.cap - 1)];
+}
+
+/*
+ * rtb_ents_realloc moves the entries in rtb->ents to the new ring of
+ * |cap| slots.  |cap| must be a power of 2 which is equal to or
+ * larger than the range of packet numbers.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory
+ */
+static int rtb_ents_realloc(ngtcp2_rtb *rtb, size_t cap) {
+  ngtcp2_rtb_ents *ents = &rtb->ents;
+  ngtcp2_rtb_entry **slots;
+  int64_t pkt_num;
+
+  slots = ngtcp2_mem_calloc(rtb->mem, cap, sizeof(slots[0]));
+  if (slots == NULL) {
+    return NGTCP2_ERR_NOMEM;
+  }
+
+  if (ents->len) {
+    for (pkt_num = ents->base; pkt_num <= ents->last; ++pkt_num) {
+      slots[(uint64_t)pkt_num & (cap - 1)] = *rtb_ents_slot(rtb, pkt_num);
+    }
+  }
+
+  ngtcp2_mem_free(rtb->mem, ents->slots);
+
+  ents->slots = slots;
+  ents->cap = cap;
+
+  return 0;
+}
+
+/*
+ * rtb_ents_reserve makes sure that rtb->ents has enough slots to
+ * store the packet numbers in the range [lo, hi], inclusive.  The
+ * range must not exceed NGTCP2_RTB_ENTS_MAX_CAP.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory
+ */
+static int rtb_ents_reserve(ngtcp2_rtb *rtb, int64_t lo, int64_t hi) {
+  ngtcp2_rtb_ents *ents = &rtb->ents;
+  size_t span, cap;
+
+  assert(lo <= hi);
+  assert((uint64_t)(hi - lo) < NGTCP2_RTB_ENTS_MAX_CAP);
+
+  span = (size_t)(hi - lo) + 1;
+  if (span <= ents->cap) {
+    return 0;
+  }
+
+  for (cap = ents->cap ? ents->cap * 2 : NGTCP2_RTB_ENTS_INITIAL_CAP;
+       cap < span; cap *= 2)
+    ;
+
+  return rtb_ents_realloc(rtb, cap);
+}
+
+/*
+ * rtb_ents_to_sparse moves the entries in the ring of rtb->ents to
+ * rtb->ents.sparse.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory
+ */
+static int rtb_ents_to_sparse(ngtcp2_rtb *rtb) {
+  ngtcp2_rtb_ents *ents = &rtb->ents;
+  ngtcp2_rtb_entry *ent;
+  int64_t pkt_num;
+  int rv;
+
+  assert(!ents->use_sparse);
+  assert(ents->len);
+
+  for (pkt_num = ents->base; pkt_num <= ents->last; ++pkt_num) {
+    ent = *rtb_ents_slot(rtb, pkt_num);
+    if (ent == NULL) {
+      continue;
+    }
+
+    rv = ngtcp2_ksl_insert(&ents->sparse, NULL, &ent->hd.pkt_num, ent);
+    if (rv != 0) {
+      ngtcp2_ksl_clear(&ents->sparse);
+      return rv;
+    }
+  }
+
+  ngtcp2_mem_free(rtb->mem, ents->slots);
+
+  ents->slots = NULL;
+  ents->cap = 0;
+  ents->use_sparse = 1;
+
+  return 0;
+}
+
+/*
+ * rtb_ents_to_ring moves the entries in rtb->ents.sparse to the
+ * ring.  If it fails to allocate the ring, the entries stay in
+ * rtb->ents.sparse.
+ */
+static void rtb_ents_to_ring(ngtcp2_rtb *rtb) {
+  ngtcp2_rtb_ents *ents = &rtb->ents;
+  ngtcp2_rtb_entry **slots;
+  ngtcp2_rtb_entry *ent;
+  ngtcp2_ksl_it it;
+  size_t span, cap;
+
+  assert(ents->use_sparse);
+  assert(ents->len);
+
+  span = (size_t)(ents->last - ents->base) + 1;
+
+  for (cap = NGTCP2_RTB_ENTS_INITIAL_CAP; cap < span; cap *= 2)
+    ;
+
+  slots = ngtcp2_mem_calloc(rtb->mem, cap, sizeof(slots[0]));
+  if (slots == NULL) {
+    return;
+  }
+
+  for (it = ngtcp2_ksl_begin(&ents->sparse); !ngtcp2_ksl_it_end(&it);
+       ngtcp2_ksl_it_next(&it)) {
+    ent = ngtcp2_ksl_it_get(&it);
+    slots[(uint64_t)ent->hd.pkt_num & (cap - 1)] = ent;
+  }
+
+  ngtcp2_ksl_clear(&ents->sparse);
+
+  ents->slots = slots;
+  ents->cap = cap;
+  ents->use_sparse = 0;
+}
+
+/*
+ * rtb_ents_insert stores |ent| in rtb->ents.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_INVALID_ARGUMENT
+ *     The entry which has the same packet number already exists.
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory
+ */
+static int rtb_ents_insert(ngtcp2_rtb *rtb, ngtcp2_rtb_entry *ent) {
+  ngtcp2_rtb_ents *ents = &rtb->ents;
+  int64_t pkt_num = ent->hd.pkt_num;
+  int64_t lo, hi;
+  int rv;
+
+  assert(pkt_num >= 0);
+
+  if (ents->len == 0) {
+    lo = hi = pkt_num;
+  } else {
+    lo = ngtcp2_min(ents->base, pkt_num);
+    hi = ngtcp2_max(ents->last, pkt_num);
+
+    if (!ents->use_sparse && lo == ents->base && hi == ents->last &&
+        *rtb_ents_slot(rtb, pkt_num)) {
+      return NGTCP2_ERR_INVALID_ARGUMENT;
+    }
+
+    if (!ents->use_sparse &&
+        (uint64_t)(hi - lo) >= NGTCP2_RTB_ENTS_MAX_CAP) {
+      rv = rtb_ents_to_sparse(rtb);
+      if (rv != 0) {
+        return rv;
+      }
+    }
+  }
+
+  if (ents->use_sparse) {
+    rv = ngtcp2_ksl_insert(&ents->sparse, NULL, &ent->hd.pkt_num, ent);
+    if (rv != 0) {
+      return rv;
+    }
+  } else {
+    rv = rtb_ents_reserve(rtb, lo, hi);
+    if (rv != 0) {
+      return rv;
+    }
+
+    *rtb_ents_slot(rtb, pkt_num) = ent;
+  }
+
+  ents->base = lo;
+  ents->last = hi;
+  ++ents->len;
+
+  return 0;
+}
+
+/*
+ * rtb_ents_remove removes the entry of packet number |pkt_num| from
+ * rtb->ents.  The entry must exist.
+ */
+static void rtb_ents_remove(ngtcp2_rtb *rtb, int64_t pkt_num) {
+  ngtcp2_rtb_ents *ents = &rtb->ents;
+  ngtcp2_ksl_it it;
+  int rv;
+
+  if (ents->use_sparse) {
+    rv = ngtcp2_ksl_remove(&ents->sparse, NULL, &pkt_num);
+    assert(0 == rv);
+    (void)rv;
+
+    if (--ents->len == 0) {
+      ents->use_sparse = 0;
+      return;
+    }
+
+    if (pkt_num == ents->last) {
+      it = ngtcp2_ksl_begin(&ents->sparse);
+      ents->last = *(int64_t *)ngtcp2_ksl_it_key(&it);
+    } else if (pkt_num == ents->base) {
+      it = ngtcp2_ksl_end(&ents->sparse);
+      ngtcp2_ksl_it_prev(&it);
+      ents->base = *(int64_t *)ngtcp2_ksl_it_key(&it);
+    }
+
+    if ((uint64_t)(ents->last - ents->base) < NGTCP2_RTB_ENTS_MAX_CAP / 2) {
+      rtb_ents_to_ring(rtb);
+    }
+
+    return;
+  }
+
+  assert(*rtb_ents_slot(rtb, pkt_num));
+
+  *rtb_ents_slot(rtb, pkt_num) = NULL;
+
+  if (--ents->len) {
+    for (; *rtb_ents_slot(rtb, ents->base) == NULL; ++ents->base)
+      ;
+
+    for (; *rtb_ents_slot(rtb, ents->last) == NULL; --ents->last)
+      ;
+  }
+
+  /* Halve the ring if the range fits in a quarter of it, so that an
+     earlier burst does not keep the memory.  The ring is kept as is
+     when it becomes empty because the next flight would grow it
+     again.  It is fine to keep the ring if the allocation fails. */
+  if (ents->len && ents->cap > NGTCP2_RTB_ENTS_INITIAL_CAP &&
+      (uint64_t)(ents->last - ents->base) < ents->cap / 4) {
+    rtb_ents_realloc(rtb, ents->cap / 2);
+  }
+}
+
+/*
+ * rtb_it_seek makes |it| point to the entry which has the largest
+ * packet number that is equal to or less than |pkt_num|.
+ */
+static void rtb_it_seek(ngtcp2_rtb_it *it, int64_t pkt_num) {
+  ngtcp2_rtb *rtb = it->rtb;
+  ngtcp2_rtb_ents *ents = &rtb->ents;
+  ngtcp2_ksl_it kit;
+
+  if (ents->len == 0 || pkt_num < ents->base) {
+    it->pkt_num = -1;
+    it->ent = NULL;
+    return;
+  }
+
+  if (ents->use_sparse) {
+    kit = ngtcp2_ksl_lower_bound(&ents->sparse, &pkt_num);
+
+    assert(!ngtcp2_ksl_it_end(&kit));
+
+    it->pkt_num = *(int64_t *)ngtcp2_ksl_it_key(&kit);
+    it->ent = ngtcp2_ksl_it_get(&kit);
+
+    return;
+  }
+
+  pkt_num = ngtcp2_min(pkt_num, ents->last);
+
+  /* The slot at ents->base is never NULL. */
+  for (; *rtb_ents_slot(rtb, pkt_num) == NULL; --pkt_num)
+    ;
+
+  it->pkt_num = pkt_num;
+  it->ent = *rtb_ents_slot(rtb, pkt_num);
+}
+
+ngtcp2_rtb_it ngtcp2_rtb_head(ngtcp2_rtb *rtb) {
+  return ngtcp2_rtb_lower_bound(rtb, INT64_MAX);
+}
+
+ngtcp2_rtb_it ngtcp2_rtb_end(ngtcp2_rtb *rtb) {
+  ngtcp2_rtb_it it = {rtb, -1, NULL};
+
+  return it;
+}
+
+ngtcp2_rtb_it ngtcp2_rtb_lower_bound(ngtcp2_rtb *rtb, int64_t pkt_num) {
+  ngtcp2_rtb_it it = {rtb, -1, NULL};
+
+  rtb_it_seek(&it, pkt_num);
+
+  return it;
+}
+
+void ngtcp2_rtb_it_next(ngtcp2_rtb_it *it) {
+  assert(!ngtcp2_rtb_it_end(it));
+
+  rtb_it_seek(it, it->pkt_num - 1);
+}
+
+void ngtcp2_rtb_it_prev(ngtcp2_rtb_it *it) {
+  ngtcp2_rtb *rtb = it->rtb;
+  ngtcp2_rtb_ents *ents = &rtb->ents;
+  ngtcp2_ksl_it kit;
+  int64_t pkt_num;
+
+  assert(!ngtcp2_rtb_it_begin(it));
+
+  if (ngtcp2_rtb_it_end(it)) {
+    rtb_it_seek(it, ents->base);
+    return;
+  }
+
+  if (ents->use_sparse) {
+    /* The entry of it->pkt_num might have been removed. */
+    kit = ngtcp2_ksl_lower_bound(&ents->sparse, &it->pkt_num);
+    ngtcp2_ksl_it_prev(&kit);
+
+    it->pkt_num = *(int64_t *)ngtcp2_ksl_it_key(&kit);
+    it->ent = ngtcp2_ksl_it_get(&kit);
+
+    return;
+  }
+
+  /* The slot at the largest packet number is never NULL. */
+  for (pkt_num = it->pkt_num + 1; *rtb_ents_slot(rtb, pkt_num) == NULL;
+       ++pkt_num)
+    ;
+
+  it->pkt_num = pkt_num;
+  it->ent = *rtb_ents_slot(rtb, pkt_num);
+}
+
+int ngtcp2_rtb_it_begin(const ngtcp2_rtb_it *it) {
+  const ngtcp2_rtb_ents *ents = &it->rtb->ents;
+
+  return ents->len == 0 || it->pkt_num == ents->last;
 }
 
 static void rtb_on_add(ngtcp2_rtb *rtb, ngtcp2_rtb_entry *ent,
@@ -530,13 +990,7 @@ static ngtcp2_ssize rtb_reclaim_frame(ngtcp2_rtb *rtb, uint8_t flags,
       ngtcp2_vec_copy(nfrc->fr.crypto.data, fr->crypto.data,
                       fr->crypto.datacnt);
 
-      rv = ngtcp2_ksl_insert(&pktns->crypto.tx.frq, NULL,
-                             &nfrc->fr.crypto.offset, nfrc);
-      if (rv != 0) {
-        assert(ngtcp2_err_is_fatal(rv));
-        ngtcp2_frame_chain_objalloc_del(nfrc, rtb->frc_objalloc, rtb->mem);
-        return rv;
-      }
+      ngtcp2_cryptofrq_push(&pktns->crypto.tx.frq, nfrc);
 
       ++num_reclaimed;
 
@@ -556,6 +1010,7 @@ static ngtcp2_ssize rtb_reclaim_frame(ngtcp2_rtb *rtb, uint8_t flags,
       break;
     case NGTCP2_FRAME_DATAGRAM:
     case NGTCP2_FRAME_DATAGRAM_LEN:
+    case NGTCP2_FRAME_REPAIR:
       continue;
     default:
       rv = ngtcp2_frame_chain_objalloc_new(&nfrc, rtb->frc_objalloc);
@@ -610,7 +1065,20 @@ static int conn_process_lost_datagram(ngtcp2_conn *conn,
   return 0;
 }
 
-static int rtb_on_pkt_lost(ngtcp2_rtb *rtb, ngtcp2_ksl_it *it,
+/*
+ * rtb_perf_switch is ngtcp2_perf_switch for |conn| which might be
+ * NULL in unit tests.
+ */
+static ngtcp2_perf_phase rtb_perf_switch(ngtcp2_conn *conn,
+                                         ngtcp2_perf_phase phase) {
+  if (!conn) {
+    return NGTCP2_PERF_PHASE_NONE;
+  }
+
+  return ngtcp2_perf_switch(&conn->perf, phase);
+}
+
+static int rtb_on_pkt_lost(ngtcp2_rtb *rtb, ngtcp2_rtb_it *it,
                            ngtcp2_rtb_entry *ent, ngtcp2_conn_stat *cstat,
                            ngtcp2_conn *conn, ngtcp2_pktns *pktns,
                            ngtcp2_tstamp ts) {
@@ -618,9 +1086,11 @@ static int rtb_on_pkt_lost(ngtcp2_rtb *rtb, ngtcp2_ksl_it *it,
   ngtcp2_ssize reclaimed;
   ngtcp2_cc *cc = rtb->cc;
   ngtcp2_cc_pkt pkt;
+  ngtcp2_perf_phase perf_phase;
 
   ngtcp2_log_pkt_lost(rtb->log, ent->hd.pkt_num, ent->hd.type, ent->hd.flags,
                       ent->ts);
+  NGTCP2_PROBE4(pkt_lost, conn, rtb->pktns_id, ent->hd.pkt_num, ent->pktlen);
 
   if (rtb->qlog) {
     ngtcp2_qlog_pkt_lost(rtb->qlog, ent);
@@ -628,13 +1098,31 @@ static int rtb_on_pkt_lost(ngtcp2_rtb *rtb, ngtcp2_ksl_it *it,
 
   if (ent->flags & NGTCP2_RTB_ENTRY_FLAG_PMTUD_PROBE) {
     ++rtb->num_lost_pmtud_pkts;
-  } else if (rtb->cc->on_pkt_lost) {
-    cc->on_pkt_lost(cc, cstat,
-                    ngtcp2_cc_pkt_init(&pkt, ent->hd.pkt_num, ent->pktlen,
-                                       rtb->pktns_id, ent->ts, ent->rst.lost,
-                                       ent->rst.tx_in_flight,
-                                       ent->rst.is_app_limited),
-                    ts);
+  } else {
+    ++cstat->lost_pkt_count;
+
+    if (conn) {
+      ++conn->dcid.current.lost_pkt_count;
+    }
+
+    if (conn && rtb->pktns_id == NGTCP2_PKTNS_ID_APPLICATION) {
+      rv = ngtcp2_conn_detect_pmtud_black_hole(conn, ent->hd.pkt_num,
+                                               ent->pktlen);
+      if (rv != 0) {
+        return rv;
+      }
+    }
+
+    if (rtb->cc->on_pkt_lost) {
+      perf_phase = rtb_perf_switch(conn, NGTCP2_PERF_PHASE_CC);
+      cc->on_pkt_lost(cc, cstat,
+                      ngtcp2_cc_pkt_init(&pkt, ent->hd.pkt_num, ent->pktlen,
+                                         rtb->pktns_id, ent->ts,
+                                         ent->rst.lost, ent->rst.tx_in_flight,
+                                         ent->rst.is_app_limited),
+                      ts);
+      rtb_perf_switch(conn, perf_phase);
+    }
   }
 
   if (ent->flags & NGTCP2_RTB_ENTRY_FLAG_PTO_RECLAIMED) {
@@ -649,7 +1137,7 @@ static int rtb_on_pkt_lost(ngtcp2_rtb *rtb, ngtcp2_ksl_it *it,
 
     ++rtb->num_lost_pkts;
 
-    ngtcp2_ksl_it_next(it);
+    ngtcp2_rtb_it_next(it);
 
     return 0;
   }
@@ -679,7 +1167,7 @@ static int rtb_on_pkt_lost(ngtcp2_rtb *rtb, ngtcp2_ksl_it *it,
 
   ++rtb->num_lost_pkts;
 
-  ngtcp2_ksl_it_next(it);
+  ngtcp2_rtb_it_next(it);
 
   return 0;
 }
@@ -688,7 +1176,7 @@ int ngtcp2_rtb_add(ngtcp2_rtb *rtb, ngtcp2_rtb_entry *ent,
                    ngtcp2_conn_stat *cstat) {
   int rv;
 
-  rv = ngtcp2_ksl_insert(&rtb->ents, NULL, &ent->hd.pkt_num, ent);
+  rv = rtb_ents_insert(rtb, ent);
   if (rv != 0) {
     return rv;
   }
@@ -698,18 +1186,22 @@ int ngtcp2_rtb_add(ngtcp2_rtb *rtb, ngtcp2_rtb_entry *ent,
   return 0;
 }
 
-ngtcp2_ksl_it ngtcp2_rtb_head(ngtcp2_rtb *rtb) {
-  return ngtcp2_ksl_begin(&rtb->ents);
+/*
+ * rtb_remove_it removes the entry pointed by |it| from rtb->ents,
+ * and advances |it| to the entry which has the next smaller packet
+ * number.
+ */
+static void rtb_remove_it(ngtcp2_rtb *rtb, ngtcp2_rtb_it *it) {
+  int64_t pkt_num = it->pkt_num;
+
+  rtb_ents_remove(rtb, pkt_num);
+  rtb_it_seek(it, pkt_num - 1);
 }
 
-static void rtb_remove(ngtcp2_rtb *rtb, ngtcp2_ksl_it *it,
+static void rtb_remove(ngtcp2_rtb *rtb, ngtcp2_rtb_it *it,
                        ngtcp2_rtb_entry **pent, ngtcp2_rtb_entry *ent,
                        ngtcp2_conn_stat *cstat) {
-  int rv;
-  (void)rv;
-
-  rv = ngtcp2_ksl_remove_hint(&rtb->ents, it, it, &ent->hd.pkt_num);
-  assert(0 == rv);
+  rtb_remove_it(rtb, it);
   rtb_on_remove(rtb, ent, cstat);
 
   assert(ent->next == NULL);
@@ -746,8 +1238,146 @@ static void conn_ack_crypto_data(ngtcp2_conn *conn, ngtcp2_pktns *pktns,
   return;
 }
 
+/*
+ * rtb_batch_acked_strm links |strm| to |*packed_strms| unless it is
+ * already linked.
+ */
+static void rtb_batch_acked_strm(ngtcp2_strm **packed_strms,
+                                 ngtcp2_strm *strm) {
+  if (strm->flags & NGTCP2_STRM_FLAG_ACK_BATCHED) {
+    return;
+  }
+
+  strm->flags |= NGTCP2_STRM_FLAG_ACK_BATCHED;
+  strm->tx.acked_prev_offset = ngtcp2_strm_get_acked_offset(strm);
+  strm->tx.pending_ack_len = 0;
+  strm->tx.acked_next = *packed_strms;
+  *packed_strms = strm;
+}
+
+/*
+ * rtb_flush_strm_ack_data passes the pending range of acknowledged
+ * data of |strm| to ngtcp2_strm_ack_data.
+ */
+static int rtb_flush_strm_ack_data(ngtcp2_strm *strm) {
+  uint64_t len = strm->tx.pending_ack_len;
+
+  if (len == 0) {
+    return 0;
+  }
+
+  strm->tx.pending_ack_len = 0;
+
+  return ngtcp2_strm_ack_data(strm, strm->tx.pending_ack_offset, len);
+}
+
+/*
+ * rtb_ack_strm_data records that the stream data [offset, offset +
+ * len) of |strm| is acknowledged.  Contiguous ranges are merged and
+ * passed to ngtcp2_strm_ack_data at once.
+ */
+static int rtb_ack_strm_data(ngtcp2_strm *strm, uint64_t offset,
+                             uint64_t len) {
+  int rv;
+
+  if (len == 0) {
+    return 0;
+  }
+
+  if (strm->tx.pending_ack_len &&
+      strm->tx.pending_ack_offset + strm->tx.pending_ack_len == offset) {
+    strm->tx.pending_ack_len += len;
+    return 0;
+  }
+
+  rv = rtb_flush_strm_ack_data(strm);
+  if (rv != 0) {
+    return rv;
+  }
+
+  strm->tx.pending_ack_offset = offset;
+  strm->tx.pending_ack_len = len;
+
+  return 0;
+}
+
+/*
+ * rtb_process_acked_strms finishes the acknowledgement of the streams
+ * in |*packed_strms|.  acked_stream_data_offset callback is called at
+ * most once per stream, and the stream is closed if it is shut down
+ * in both directions.  The processed streams are unlinked from
+ * |*packed_strms|.
+ */
+static int rtb_process_acked_strms(ngtcp2_conn *conn,
+                                   ngtcp2_strm **packed_strms) {
+  ngtcp2_strm *strm;
+  uint64_t datalen;
+  int fin;
+  int rv;
+
+  for (; *packed_strms;) {
+    strm = *packed_strms;
+    *packed_strms = strm->tx.acked_next;
+
+    fin = (strm->flags & NGTCP2_STRM_FLAG_FIN_ACK_BATCHED) != 0;
+    strm->flags &= (uint32_t) ~(NGTCP2_STRM_FLAG_ACK_BATCHED |
+                                NGTCP2_STRM_FLAG_FIN_ACK_BATCHED);
+
+    rv = rtb_flush_strm_ack_data(strm);
+    if (rv != 0) {
+      return rv;
+    }
+
+    if (conn->callbacks.acked_stream_data_offset) {
+      datalen = ngtcp2_strm_get_acked_offset(strm) - strm->tx.acked_prev_offset;
+      if (datalen || fin) {
+        rv = conn->callbacks.acked_stream_data_offset(
+            conn, strm->stream_id, strm->tx.acked_prev_offset, datalen,
+            conn->user_data, strm->stream_user_data);
+        if (rv != 0) {
+          return NGTCP2_ERR_CALLBACK_FAILURE;
+        }
+      }
+    }
+
+    ngtcp2_conn_release_acked_stream_bufs(conn, strm);
+
+    rv = ngtcp2_conn_close_stream_if_shut_rdwr(conn, strm);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * rtb_drop_acked_strms unlinks all streams from |*packed_strms|
+ * without processing them.
+ */
+static void rtb_drop_acked_strms(ngtcp2_strm **packed_strms) {
+  ngtcp2_strm *strm;
+
+  for (; *packed_strms;) {
+    strm = *packed_strms;
+    *packed_strms = strm->tx.acked_next;
+
+    strm->flags &= (uint32_t) ~(NGTCP2_STRM_FLAG_ACK_BATCHED |
+                                NGTCP2_STRM_FLAG_FIN_ACK_BATCHED);
+    strm->tx.pending_ack_len = 0;
+  }
+}
+
+/*
+ * rtb_process_acked_pkt processes the frames in the acknowledged
+ * |ent|.  The streams whose STREAM or RESET_STREAM frames are
+ * acknowledged are linked to |*packed_strms|, and their processing is
+ * completed by rtb_process_acked_strms after all packets that an ACK
+ * frame acknowledges are processed.
+ */
 static int rtb_process_acked_pkt(ngtcp2_rtb *rtb, ngtcp2_rtb_entry *ent,
-                                 ngtcp2_conn *conn) {
+                                 ngtcp2_conn *conn,
+                                 ngtcp2_strm **packed_strms) {
   ngtcp2_frame_chain *frc;
   uint64_t prev_stream_offset, stream_offset;
   ngtcp2_strm *strm;
@@ -768,6 +1398,13 @@ static int rtb_process_acked_pkt(ngtcp2_rtb *rtb, ngtcp2_rtb_entry *ent,
     }
   }
 
+  if (rtb->pktns_id == NGTCP2_PKTNS_ID_APPLICATION &&
+      ent->pktlen > NGTCP2_MAX_UDP_PAYLOAD_SIZE &&
+      conn->pmtud_bh.max_ack_pkt_num < ent->hd.pkt_num) {
+    conn->pmtud_bh.max_ack_pkt_num = ent->hd.pkt_num;
+    conn->pmtud_bh.num_lost = 0;
+  }
+
   for (frc = ent->frc; frc; frc = frc->next) {
     if (frc->binder) {
       frc->binder->flags |= NGTCP2_FRAME_CHAIN_BINDER_FLAG_ACK;
@@ -782,37 +1419,19 @@ static int rtb_process_acked_pkt(ngtcp2_rtb *rtb, ngtcp2_rtb_entry *ent,
 
       strm->flags |= NGTCP2_STRM_FLAG_ANY_ACKED;
 
+      rtb_batch_acked_strm(packed_strms, strm);
+
       if (frc->fr.stream.fin) {
-        strm->flags |= NGTCP2_STRM_FLAG_FIN_ACKED;
+        strm->flags |=
+            NGTCP2_STRM_FLAG_FIN_ACKED | NGTCP2_STRM_FLAG_FIN_ACK_BATCHED;
       }
 
-      prev_stream_offset = ngtcp2_strm_get_acked_offset(strm);
-      rv = ngtcp2_strm_ack_data(
+      rv = rtb_ack_strm_data(
           strm, frc->fr.stream.offset,
           ngtcp2_vec_len(frc->fr.stream.data, frc->fr.stream.datacnt));
       if (rv != 0) {
         return rv;
       }
-
-      if (conn->callbacks.acked_stream_data_offset) {
-        stream_offset = ngtcp2_strm_get_acked_offset(strm);
-        datalen = stream_offset - prev_stream_offset;
-        if (datalen == 0 && !frc->fr.stream.fin) {
-          break;
-        }
-
-        rv = conn->callbacks.acked_stream_data_offset(
-            conn, strm->stream_id, prev_stream_offset, datalen, conn->user_data,
-            strm->stream_user_data);
-        if (rv != 0) {
-          return NGTCP2_ERR_CALLBACK_FAILURE;
-        }
-      }
-
-      rv = ngtcp2_conn_close_stream_if_shut_rdwr(conn, strm);
-      if (rv != 0) {
-        return rv;
-      }
       break;
     case NGTCP2_FRAME_CRYPTO:
       prev_stream_offset = ngtcp2_strm_get_acked_offset(crypto);
@@ -852,10 +1471,7 @@ static int rtb_process_acked_pkt(ngtcp2_rtb *rtb, ngtcp2_rtb_entry *ent,
         break;
       }
       strm->flags |= NGTCP2_STRM_FLAG_RST_ACKED;
-      rv = ngtcp2_conn_close_stream_if_shut_rdwr(conn, strm);
-      if (rv != 0) {
-        return rv;
-      }
+      rtb_batch_acked_strm(packed_strms, strm);
       break;
     case NGTCP2_FRAME_RETIRE_CONNECTION_ID:
       ngtcp2_conn_untrack_retired_dcid_seq(conn,
@@ -913,9 +1529,11 @@ static void conn_verify_ecn(ngtcp2_conn *conn, ngtcp2_pktns *pktns,
         pktns->rx.ecn.ack.ect1 > fr->ecn.ect1 ||
         pktns->rx.ecn.ack.ce > fr->ecn.ce ||
         (fr->ecn.ect0 - pktns->rx.ecn.ack.ect0) +
+                (fr->ecn.ect1 - pktns->rx.ecn.ack.ect1) +
                 (fr->ecn.ce - pktns->rx.ecn.ack.ce) <
             ecn_acked ||
-        fr->ecn.ect0 > pktns->tx.ecn.ect0 || fr->ecn.ect1))) {
+        fr->ecn.ect0 > pktns->tx.ecn.ect0 ||
+        fr->ecn.ect1 > pktns->tx.ecn.ect1))) {
     ngtcp2_log_info(&conn->log, NGTCP2_LOG_EVENT_CON,
                     "path is not ECN capable");
     conn->tx.ecn.state = NGTCP2_ECN_STATE_FAILED;
@@ -928,9 +1546,19 @@ static void conn_verify_ecn(ngtcp2_conn *conn, ngtcp2_pktns *pktns,
   }
 
   if (fr->type == NGTCP2_FRAME_ACK_ECN) {
-    if (largest_acked_sent_ts != UINT64_MAX &&
-        fr->ecn.ce > pktns->rx.ecn.ack.ce) {
-      cc->congestion_event(cc, cstat, largest_acked_sent_ts, ts);
+    if (largest_acked_sent_ts != UINT64_MAX) {
+      if (cc->on_ecn_ack) {
+        cc->on_ecn_ack(cc, cstat,
+                       (fr->ecn.ect0 - pktns->rx.ecn.ack.ect0) +
+                           (fr->ecn.ect1 - pktns->rx.ecn.ack.ect1),
+                       fr->ecn.ce - pktns->rx.ecn.ack.ce,
+                       largest_acked_sent_ts, ts);
+      } else if (fr->ecn.ce > pktns->rx.ecn.ack.ce) {
+        cc->congestion_event(cc, cstat, largest_acked_sent_ts, ts);
+      }
+
+      NGTCP2_PROBE4(cwnd, conn, cstat->cwnd, cstat->bytes_in_flight,
+                    cstat->ssthresh);
     }
 
     pktns->rx.ecn.ack.ect0 = fr->ecn.ect0;
@@ -943,26 +1571,65 @@ static int rtb_detect_lost_pkt(ngtcp2_rtb *rtb, uint64_t *ppkt_lost,
                                ngtcp2_conn *conn, ngtcp2_pktns *pktns,
                                ngtcp2_conn_stat *cstat, ngtcp2_tstamp ts);
 
+/*
+ * rtb_on_spurious_loss is called when |ent| which has been declared
+ * lost is acknowledged.  The packet was reordered rather than lost,
+ * and this function widens the packet and time thresholds of loss
+ * detection so that the same amount of reordering is tolerated
+ * later.
+ */
+static void rtb_on_spurious_loss(ngtcp2_rtb *rtb, const ngtcp2_rtb_entry *ent,
+                                 ngtcp2_conn_stat *cstat, ngtcp2_tstamp ts) {
+  uint64_t pkt_thres;
+
+  ++cstat->spurious_loss_count;
+
+  if (rtb->largest_acked_tx_pkt_num > ent->hd.pkt_num) {
+    pkt_thres = (uint64_t)(rtb->largest_acked_tx_pkt_num - ent->hd.pkt_num) + 1;
+    pkt_thres = ngtcp2_min(pkt_thres, NGTCP2_MAX_PKT_THRESHOLD);
+    rtb->reorder.pkt_thres =
+        ngtcp2_max(rtb->reorder.pkt_thres, (size_t)pkt_thres);
+  }
+
+  /* Like RACK, increase the reordering window at most once per round
+     trip. */
+  if (rtb->reorder.next_ts <= ts) {
+    ++rtb->reorder.wnd_mult;
+    rtb->reorder.next_ts = ts + cstat->smoothed_rtt;
+  }
+
+  rtb->reorder.wnd_persist = NGTCP2_REO_WND_PERSIST;
+
+  ngtcp2_log_info(rtb->log, NGTCP2_LOG_EVENT_RCV,
+                  "pkn=%" PRId64 " was spuriously declared lost pkt_thres=%zu"
+                  " reo_wnd_mult=%zu",
+                  ent->hd.pkt_num, rtb->reorder.pkt_thres,
+                  rtb->reorder.wnd_mult);
+}
+
 ngtcp2_ssize ngtcp2_rtb_recv_ack(ngtcp2_rtb *rtb, const ngtcp2_ack *fr,
                                  ngtcp2_conn_stat *cstat, ngtcp2_conn *conn,
                                  ngtcp2_pktns *pktns, ngtcp2_tstamp pkt_ts,
                                  ngtcp2_tstamp ts) {
   ngtcp2_rtb_entry *ent;
   int64_t largest_ack = fr->largest_ack, min_ack;
-  size_t i;
+  ngtcp2_ack_range_it range_it;
+  ngtcp2_ack_blk blk;
   int rv;
-  ngtcp2_ksl_it it;
+  ngtcp2_rtb_it it;
   ngtcp2_ssize num_acked = 0;
   ngtcp2_tstamp largest_pkt_sent_ts = UINT64_MAX;
   ngtcp2_tstamp largest_acked_sent_ts = UINT64_MAX;
   int64_t pkt_num;
   ngtcp2_cc *cc = rtb->cc;
   ngtcp2_rtb_entry *acked_ent = NULL;
+  ngtcp2_strm *acked_strms = NULL;
   int ack_eliciting_pkt_acked = 0;
   size_t ecn_acked = 0;
   int verify_ecn = 0;
   ngtcp2_cc_ack cc_ack = {0};
   size_t num_lost_pkts = rtb->num_lost_pkts - rtb->num_lost_pmtud_pkts;
+  ngtcp2_perf_phase perf_phase;
 
   cc_ack.prior_bytes_in_flight = cstat->bytes_in_flight;
   cc_ack.rtt = UINT64_MAX;
@@ -983,8 +1650,8 @@ ngtcp2_ssize ngtcp2_rtb_recv_ack(ngtcp2_rtb *rtb, const ngtcp2_ack *fr,
   }
 
   /* Assume that ngtcp2_pkt_validate_ack(fr) returns 0 */
-  it = ngtcp2_ksl_lower_bound(&rtb->ents, &largest_ack);
-  if (ngtcp2_ksl_it_end(&it)) {
+  it = ngtcp2_rtb_lower_bound(rtb, largest_ack);
+  if (ngtcp2_rtb_it_end(&it)) {
     if (conn && verify_ecn) {
       conn_verify_ecn(conn, pktns, rtb->cc, cstat, fr, ecn_acked,
                       largest_acked_sent_ts, ts);
@@ -994,8 +1661,8 @@ ngtcp2_ssize ngtcp2_rtb_recv_ack(ngtcp2_rtb *rtb, const ngtcp2_ack *fr,
 
   min_ack = largest_ack - (int64_t)fr->first_ack_blklen;
 
-  for (; !ngtcp2_ksl_it_end(&it);) {
-    pkt_num = *(int64_t *)ngtcp2_ksl_it_key(&it);
+  for (; !ngtcp2_rtb_it_end(&it);) {
+    pkt_num = it.pkt_num;
 
     assert(pkt_num <= largest_ack);
 
@@ -1003,7 +1670,7 @@ ngtcp2_ssize ngtcp2_rtb_recv_ack(ngtcp2_rtb *rtb, const ngtcp2_ack *fr,
       break;
     }
 
-    ent = ngtcp2_ksl_it_get(&it);
+    ent = ngtcp2_rtb_it_get(&it);
 
     if (largest_ack == pkt_num) {
       largest_pkt_sent_ts = ent->ts;
@@ -1017,21 +1684,23 @@ ngtcp2_ssize ngtcp2_rtb_recv_ack(ngtcp2_rtb *rtb, const ngtcp2_ack *fr,
     ++num_acked;
   }
 
-  for (i = 0; i < fr->num_blks;) {
-    largest_ack = min_ack - (int64_t)fr->blks[i].gap - 2;
-    min_ack = largest_ack - (int64_t)fr->blks[i].blklen;
+  ngtcp2_ack_range_it_init(&range_it, fr);
+
+  while (ngtcp2_ack_range_it_next(&range_it, &blk)) {
+    largest_ack = min_ack - (int64_t)blk.gap - 2;
+    min_ack = largest_ack - (int64_t)blk.blklen;
 
-    it = ngtcp2_ksl_lower_bound(&rtb->ents, &largest_ack);
-    if (ngtcp2_ksl_it_end(&it)) {
+    it = ngtcp2_rtb_lower_bound(rtb, largest_ack);
+    if (ngtcp2_rtb_it_end(&it)) {
       break;
     }
 
-    for (; !ngtcp2_ksl_it_end(&it);) {
-      pkt_num = *(int64_t *)ngtcp2_ksl_it_key(&it);
+    for (; !ngtcp2_rtb_it_end(&it);) {
+      pkt_num = it.pkt_num;
       if (pkt_num < min_ack) {
         break;
       }
-      ent = ngtcp2_ksl_it_get(&it);
+      ent = ngtcp2_rtb_it_get(&it);
 
       if (ent->flags & NGTCP2_RTB_ENTRY_FLAG_ACK_ELICITING) {
         ack_eliciting_pkt_acked = 1;
@@ -1040,8 +1709,6 @@ ngtcp2_ssize ngtcp2_rtb_recv_ack(ngtcp2_rtb *rtb, const ngtcp2_ack *fr,
       rtb_remove(rtb, &it, &acked_ent, ent, cstat);
       ++num_acked;
     }
-
-    ++i;
   }
 
   if (largest_pkt_sent_ts != UINT64_MAX && ack_eliciting_pkt_acked) {
@@ -1049,7 +1716,9 @@ ngtcp2_ssize ngtcp2_rtb_recv_ack(ngtcp2_rtb *rtb, const ngtcp2_ack *fr,
 
     rv = ngtcp2_conn_update_rtt(conn, cc_ack.rtt, fr->ack_delay_unscaled, ts);
     if (rv == 0 && cc->new_rtt_sample) {
+      perf_phase = rtb_perf_switch(conn, NGTCP2_PERF_PHASE_CC);
       cc->new_rtt_sample(cc, cstat, ts);
+      rtb_perf_switch(conn, perf_phase);
     }
   }
 
@@ -1065,11 +1734,17 @@ ngtcp2_ssize ngtcp2_rtb_recv_ack(ngtcp2_rtb *rtb, const ngtcp2_ack *fr,
 
       largest_acked_sent_ts = ent->ts;
 
-      rv = rtb_process_acked_pkt(rtb, ent, conn);
+      rv = rtb_process_acked_pkt(rtb, ent, conn, &acked_strms);
       if (rv != 0) {
         goto fail;
       }
 
+      if ((ent->flags & (NGTCP2_RTB_ENTRY_FLAG_LOST_RETRANSMITTED |
+                         NGTCP2_RTB_ENTRY_FLAG_PMTUD_PROBE)) ==
+          NGTCP2_RTB_ENTRY_FLAG_LOST_RETRANSMITTED) {
+        rtb_on_spurious_loss(rtb, ent, cstat, ts);
+      }
+
       if (ent->hd.pkt_num >= rtb->cc_pkt_num) {
         assert(cc_ack.pkt_delivered <= ent->rst.delivered);
 
@@ -1077,12 +1752,19 @@ ngtcp2_ssize ngtcp2_rtb_recv_ack(ngtcp2_rtb *rtb, const ngtcp2_ack *fr,
         cc_ack.pkt_delivered = ent->rst.delivered;
       }
 
+      perf_phase = ngtcp2_perf_switch(&conn->perf, NGTCP2_PERF_PHASE_CC);
       rtb_on_pkt_acked(rtb, ent, cstat, ts);
+      ngtcp2_perf_switch(&conn->perf, perf_phase);
       acked_ent = ent->next;
       ngtcp2_rtb_entry_objalloc_del(ent, rtb->rtb_entry_objalloc,
                                     rtb->frc_objalloc, rtb->mem);
     }
 
+    rv = rtb_process_acked_strms(conn, &acked_strms);
+    if (rv != 0) {
+      goto fail;
+    }
+
     if (verify_ecn) {
       conn_verify_ecn(conn, pktns, rtb->cc, cstat, fr, ecn_acked,
                       largest_acked_sent_ts, ts);
@@ -1099,13 +1781,20 @@ ngtcp2_ssize ngtcp2_rtb_recv_ack(ngtcp2_rtb *rtb, const ngtcp2_ack *fr,
 
   if (rtb->cc->on_spurious_congestion && num_lost_pkts &&
       rtb->num_lost_pkts - rtb->num_lost_pmtud_pkts == 0) {
+    ++cstat->spurious_congestion_count;
+
+    perf_phase = rtb_perf_switch(conn, NGTCP2_PERF_PHASE_CC);
     rtb->cc->on_spurious_congestion(cc, cstat, ts);
+    rtb_perf_switch(conn, perf_phase);
   }
 
   ngtcp2_rst_on_ack_recv(rtb->rst, cstat, cc_ack.pkt_delivered);
 
   if (conn && num_acked > 0) {
+    perf_phase =
+        ngtcp2_perf_switch(&conn->perf, NGTCP2_PERF_PHASE_LOSS_DETECTION);
     rv = rtb_detect_lost_pkt(rtb, &cc_ack.bytes_lost, conn, pktns, cstat, ts);
+    ngtcp2_perf_switch(&conn->perf, perf_phase);
     if (rv != 0) {
       return rv;
     }
@@ -1114,11 +1803,18 @@ ngtcp2_ssize ngtcp2_rtb_recv_ack(ngtcp2_rtb *rtb, const ngtcp2_ack *fr,
   rtb->rst->lost += cc_ack.bytes_lost;
 
   cc_ack.largest_acked_sent_ts = largest_acked_sent_ts;
+  perf_phase = rtb_perf_switch(conn, NGTCP2_PERF_PHASE_CC);
   cc->on_ack_recv(cc, cstat, &cc_ack, ts);
+  rtb_perf_switch(conn, perf_phase);
+
+  NGTCP2_PROBE4(cwnd, conn, cstat->cwnd, cstat->bytes_in_flight,
+                cstat->ssthresh);
 
   return num_acked;
 
 fail:
+  rtb_drop_acked_strms(&acked_strms);
+
   for (ent = acked_ent; ent; ent = acked_ent) {
     acked_ent = ent->next;
     ngtcp2_rtb_entry_objalloc_del(ent, rtb->rtb_entry_objalloc,
@@ -1161,6 +1857,22 @@ static ngtcp2_duration compute_pkt_loss_delay(const ngtcp2_conn_stat *cstat) {
   return ngtcp2_max(loss_delay, NGTCP2_GRANULARITY);
 }
 
+/*
+ * rtb_compute_reorder_wnd returns the extra time that loss detection
+ * waits for the reordered packets.  It is min_rtt / 4 multiplied by
+ * the number of times that the spurious loss is detected, and capped
+ * by smoothed_rtt (see RFC 8985).
+ */
+static ngtcp2_duration rtb_compute_reorder_wnd(const ngtcp2_rtb *rtb,
+                                               const ngtcp2_conn_stat *cstat) {
+  if (rtb->reorder.wnd_mult == 0 || cstat->min_rtt == UINT64_MAX) {
+    return 0;
+  }
+
+  return ngtcp2_min(cstat->min_rtt / 4 * rtb->reorder.wnd_mult,
+                    cstat->smoothed_rtt);
+}
+
 /*
  * conn_all_ecn_pkt_lost returns nonzero if all ECN QUIC packets are
  * lost during validation period.
@@ -1182,7 +1894,7 @@ static int rtb_detect_lost_pkt(ngtcp2_rtb *rtb, uint64_t *ppkt_lost,
                                ngtcp2_conn_stat *cstat, ngtcp2_tstamp ts) {
   ngtcp2_rtb_entry *ent;
   ngtcp2_duration loss_delay;
-  ngtcp2_ksl_it it;
+  ngtcp2_rtb_it it;
   ngtcp2_tstamp latest_ts, oldest_ts;
   int64_t last_lost_pkt_num;
   ngtcp2_duration loss_window, congestion_period;
@@ -1195,15 +1907,17 @@ static int rtb_detect_lost_pkt(ngtcp2_rtb *rtb, uint64_t *ppkt_lost,
   ngtcp2_duration pto = ngtcp2_conn_compute_pto(conn, pktns);
   uint64_t bytes_lost = 0;
   ngtcp2_duration max_ack_delay;
+  ngtcp2_perf_phase perf_phase;
 
-  pkt_thres = ngtcp2_max(pkt_thres, NGTCP2_PKT_THRESHOLD);
-  pkt_thres = ngtcp2_min(pkt_thres, 256);
+  pkt_thres = ngtcp2_max(pkt_thres, rtb->reorder.pkt_thres);
+  pkt_thres = ngtcp2_min(pkt_thres, NGTCP2_MAX_PKT_THRESHOLD);
   cstat->loss_time[rtb->pktns_id] = UINT64_MAX;
-  loss_delay = compute_pkt_loss_delay(cstat);
+  loss_delay =
+      compute_pkt_loss_delay(cstat) + rtb_compute_reorder_wnd(rtb, cstat);
 
-  it = ngtcp2_ksl_lower_bound(&rtb->ents, &rtb->largest_acked_tx_pkt_num);
-  for (; !ngtcp2_ksl_it_end(&it); ngtcp2_ksl_it_next(&it)) {
-    ent = ngtcp2_ksl_it_get(&it);
+  it = ngtcp2_rtb_lower_bound(rtb, rtb->largest_acked_tx_pkt_num);
+  for (; !ngtcp2_rtb_it_end(&it); ngtcp2_rtb_it_next(&it)) {
+    ent = ngtcp2_rtb_it_get(&it);
 
     if (ent->flags & NGTCP2_RTB_ENTRY_FLAG_LOST_RETRANSMITTED) {
       break;
@@ -1225,8 +1939,8 @@ static int rtb_detect_lost_pkt(ngtcp2_rtb *rtb, uint64_t *ppkt_lost,
       start_ts = ngtcp2_max(rtb->persistent_congestion_start_ts,
                             cstat->first_rtt_sample_ts);
 
-      for (; !ngtcp2_ksl_it_end(&it);) {
-        ent = ngtcp2_ksl_it_get(&it);
+      for (; !ngtcp2_rtb_it_end(&it);) {
+        ent = ngtcp2_rtb_it_get(&it);
 
         if (last_lost_pkt_num == ent->hd.pkt_num + 1 && ent->ts >= start_ts) {
           last_lost_pkt_num = ent->hd.pkt_num;
@@ -1241,7 +1955,7 @@ static int rtb_detect_lost_pkt(ngtcp2_rtb *rtb, uint64_t *ppkt_lost,
               latest_ts - oldest_ts >= congestion_period) {
             break;
           }
-          ngtcp2_ksl_it_next(&it);
+          ngtcp2_rtb_it_next(&it);
           continue;
         }
 
@@ -1288,7 +2002,16 @@ static int rtb_detect_lost_pkt(ngtcp2_rtb *rtb, uint64_t *ppkt_lost,
         break;
       }
 
+      perf_phase = rtb_perf_switch(conn, NGTCP2_PERF_PHASE_CC);
       cc->congestion_event(cc, cstat, latest_ts, ts);
+      rtb_perf_switch(conn, perf_phase);
+
+      NGTCP2_PROBE4(cwnd, conn, cstat->cwnd, cstat->bytes_in_flight,
+                    cstat->ssthresh);
+
+      if (rtb->reorder.wnd_persist && --rtb->reorder.wnd_persist == 0) {
+        rtb_reorder_reset(rtb);
+      }
 
       loss_window = latest_ts - oldest_ts;
       /* Persistent congestion situation is only evaluated for app
@@ -1312,7 +2035,12 @@ static int rtb_detect_lost_pkt(ngtcp2_rtb *rtb, uint64_t *ppkt_lost,
           cstat->rttvar = conn->local.settings.initial_rtt / 2;
           cstat->first_rtt_sample_ts = UINT64_MAX;
 
+          perf_phase = rtb_perf_switch(conn, NGTCP2_PERF_PHASE_CC);
           cc->on_persistent_congestion(cc, cstat, ts);
+          rtb_perf_switch(conn, perf_phase);
+
+          NGTCP2_PROBE4(cwnd, conn, cstat->cwnd, cstat->bytes_in_flight,
+                        cstat->ssthresh);
         }
       }
 
@@ -1337,15 +2065,15 @@ int ngtcp2_rtb_detect_lost_pkt(ngtcp2_rtb *rtb, ngtcp2_conn *conn,
 }
 
 void ngtcp2_rtb_remove_excessive_lost_pkt(ngtcp2_rtb *rtb, size_t n) {
-  ngtcp2_ksl_it it = ngtcp2_ksl_end(&rtb->ents);
+  ngtcp2_rtb_it it = ngtcp2_rtb_end(rtb);
   ngtcp2_rtb_entry *ent;
   int rv;
   (void)rv;
 
   for (; rtb->num_lost_pkts > n;) {
-    assert(ngtcp2_ksl_it_end(&it));
-    ngtcp2_ksl_it_prev(&it);
-    ent = ngtcp2_ksl_it_get(&it);
+    assert(ngtcp2_rtb_it_end(&it));
+    ngtcp2_rtb_it_prev(&it);
+    ent = ngtcp2_rtb_it_get(&it);
 
     assert(ent->flags & NGTCP2_RTB_ENTRY_FLAG_LOST_RETRANSMITTED);
 
@@ -1358,8 +2086,7 @@ void ngtcp2_rtb_remove_excessive_lost_pkt(ngtcp2_rtb *rtb, size_t n) {
       --rtb->num_lost_pmtud_pkts;
     }
 
-    rv = ngtcp2_ksl_remove_hint(&rtb->ents, &it, &it, &ent->hd.pkt_num);
-    assert(0 == rv);
+    rtb_remove_it(rtb, &it);
     ngtcp2_rtb_entry_objalloc_del(ent, rtb->rtb_entry_objalloc,
                                   rtb->frc_objalloc, rtb->mem);
   }
@@ -1367,22 +2094,22 @@ void ngtcp2_rtb_remove_excessive_lost_pkt(ngtcp2_rtb *rtb, size_t n) {
 
 void ngtcp2_rtb_remove_expired_lost_pkt(ngtcp2_rtb *rtb, ngtcp2_duration pto,
                                         ngtcp2_tstamp ts) {
-  ngtcp2_ksl_it it;
+  ngtcp2_rtb_it it;
   ngtcp2_rtb_entry *ent;
   int rv;
   (void)rv;
 
-  if (ngtcp2_ksl_len(&rtb->ents) == 0) {
+  if (rtb->ents.len == 0) {
     return;
   }
 
-  it = ngtcp2_ksl_end(&rtb->ents);
+  it = ngtcp2_rtb_end(rtb);
 
   for (;;) {
-    assert(ngtcp2_ksl_it_end(&it));
+    assert(ngtcp2_rtb_it_end(&it));
 
-    ngtcp2_ksl_it_prev(&it);
-    ent = ngtcp2_ksl_it_get(&it);
+    ngtcp2_rtb_it_prev(&it);
+    ent = ngtcp2_rtb_it_get(&it);
 
     if (!(ent->flags & NGTCP2_RTB_ENTRY_FLAG_LOST_RETRANSMITTED) ||
         ts - ent->lost_ts < pto) {
@@ -1398,28 +2125,27 @@ void ngtcp2_rtb_remove_expired_lost_pkt(ngtcp2_rtb *rtb, ngtcp2_duration pto,
       --rtb->num_lost_pmtud_pkts;
     }
 
-    rv = ngtcp2_ksl_remove_hint(&rtb->ents, &it, &it, &ent->hd.pkt_num);
-    assert(0 == rv);
+    rtb_remove_it(rtb, &it);
     ngtcp2_rtb_entry_objalloc_del(ent, rtb->rtb_entry_objalloc,
                                   rtb->frc_objalloc, rtb->mem);
 
-    if (ngtcp2_ksl_len(&rtb->ents) == 0) {
+    if (rtb->ents.len == 0) {
       return;
     }
   }
 }
 
 ngtcp2_tstamp ngtcp2_rtb_lost_pkt_ts(ngtcp2_rtb *rtb) {
-  ngtcp2_ksl_it it;
+  ngtcp2_rtb_it it;
   ngtcp2_rtb_entry *ent;
 
-  if (ngtcp2_ksl_len(&rtb->ents) == 0) {
+  if (rtb->ents.len == 0) {
     return UINT64_MAX;
   }
 
-  it = ngtcp2_ksl_end(&rtb->ents);
-  ngtcp2_ksl_it_prev(&it);
-  ent = ngtcp2_ksl_it_get(&it);
+  it = ngtcp2_rtb_end(rtb);
+  ngtcp2_rtb_it_prev(&it);
+  ent = ngtcp2_rtb_it_get(&it);
 
   if (!(ent->flags & NGTCP2_RTB_ENTRY_FLAG_LOST_RETRANSMITTED)) {
     return UINT64_MAX;
@@ -1439,6 +2165,7 @@ static int rtb_on_pkt_lost_resched_move(ngtcp2_rtb *rtb, ngtcp2_conn *conn,
 
   ngtcp2_log_pkt_lost(rtb->log, ent->hd.pkt_num, ent->hd.type, ent->hd.flags,
                       ent->ts);
+  NGTCP2_PROBE4(pkt_lost, conn, rtb->pktns_id, ent->hd.pkt_num, ent->pktlen);
 
   if (rtb->qlog) {
     ngtcp2_qlog_pkt_lost(rtb->qlog, ent);
@@ -1452,7 +2179,9 @@ static int rtb_on_pkt_lost_resched_move(ngtcp2_rtb *rtb, ngtcp2_conn *conn,
     return 0;
   }
 
-  if (ent->flags & NGTCP2_RTB_ENTRY_FLAG_PMTUD_PROBE) {
+  if ((ent->flags & (NGTCP2_RTB_ENTRY_FLAG_PMTUD_PROBE |
+                     NGTCP2_RTB_ENTRY_FLAG_RETRANSMITTABLE)) ==
+      NGTCP2_RTB_ENTRY_FLAG_PMTUD_PROBE) {
     ngtcp2_log_info(rtb->log, NGTCP2_LOG_EVENT_RCV,
                     "pkn=%" PRId64
                     " is a PMTUD probe packet, no retransmission is necessary",
@@ -1528,13 +2257,7 @@ static int rtb_on_pkt_lost_resched_move(ngtcp2_rtb *rtb, ngtcp2_conn *conn,
       *pfrc = frc->next;
       frc->next = NULL;
 
-      rv = ngtcp2_ksl_insert(&pktns->crypto.tx.frq, NULL,
-                             &frc->fr.crypto.offset, frc);
-      if (rv != 0) {
-        assert(ngtcp2_err_is_fatal(rv));
-        ngtcp2_frame_chain_objalloc_del(frc, rtb->frc_objalloc, rtb->mem);
-        return rv;
-      }
+      ngtcp2_cryptofrq_push(&pktns->crypto.tx.frq, frc);
       break;
     case NGTCP2_FRAME_DATAGRAM:
     case NGTCP2_FRAME_DATAGRAM_LEN:
@@ -1550,6 +2273,27 @@ static int rtb_on_pkt_lost_resched_move(ngtcp2_rtb *rtb, ngtcp2_conn *conn,
 
       *pfrc = (*pfrc)->next;
 
+      ngtcp2_frame_chain_objalloc_del(frc, rtb->frc_objalloc, rtb->mem);
+      break;
+    case NGTCP2_FRAME_REPAIR:
+      /* REPAIR is not retransmitted because the lost STREAM frames
+         it protects are retransmitted anyway. */
+      frc = *pfrc;
+      *pfrc = (*pfrc)->next;
+
+      ngtcp2_frame_chain_objalloc_del(frc, rtb->frc_objalloc, rtb->mem);
+      break;
+    case NGTCP2_FRAME_ACK_FREQUENCY:
+      /* ACK_FREQUENCY superseded by the newer one is not
+         retransmitted. */
+      if ((*pfrc)->fr.ack_frequency.seq + 1 == conn->tx.ack_freq.seq) {
+        pfrc = &(*pfrc)->next;
+        break;
+      }
+
+      frc = *pfrc;
+      *pfrc = (*pfrc)->next;
+
       ngtcp2_frame_chain_objalloc_del(frc, rtb->frc_objalloc, rtb->mem);
       break;
     default:
@@ -1567,17 +2311,16 @@ static int rtb_on_pkt_lost_resched_move(ngtcp2_rtb *rtb, ngtcp2_conn *conn,
 int ngtcp2_rtb_remove_all(ngtcp2_rtb *rtb, ngtcp2_conn *conn,
                           ngtcp2_pktns *pktns, ngtcp2_conn_stat *cstat) {
   ngtcp2_rtb_entry *ent;
-  ngtcp2_ksl_it it;
+  ngtcp2_rtb_it it;
   int rv;
 
-  it = ngtcp2_ksl_begin(&rtb->ents);
+  it = ngtcp2_rtb_head(rtb);
 
-  for (; !ngtcp2_ksl_it_end(&it);) {
-    ent = ngtcp2_ksl_it_get(&it);
+  for (; !ngtcp2_rtb_it_end(&it);) {
+    ent = ngtcp2_rtb_it_get(&it);
 
     rtb_on_remove(rtb, ent, cstat);
-    rv = ngtcp2_ksl_remove_hint(&rtb->ents, &it, &it, &ent->hd.pkt_num);
-    assert(0 == rv);
+    rtb_remove_it(rtb, &it);
 
     rv = rtb_on_pkt_lost_resched_move(rtb, conn, pktns, ent);
     ngtcp2_rtb_entry_objalloc_del(ent, rtb->rtb_entry_objalloc,
@@ -1592,23 +2335,22 @@ int ngtcp2_rtb_remove_all(ngtcp2_rtb *rtb, ngtcp2_conn *conn,
 
 void ngtcp2_rtb_remove_early_data(ngtcp2_rtb *rtb, ngtcp2_conn_stat *cstat) {
   ngtcp2_rtb_entry *ent;
-  ngtcp2_ksl_it it;
+  ngtcp2_rtb_it it;
   int rv;
   (void)rv;
 
-  it = ngtcp2_ksl_begin(&rtb->ents);
+  it = ngtcp2_rtb_head(rtb);
 
-  for (; !ngtcp2_ksl_it_end(&it);) {
-    ent = ngtcp2_ksl_it_get(&it);
+  for (; !ngtcp2_rtb_it_end(&it);) {
+    ent = ngtcp2_rtb_it_get(&it);
 
     if (ent->hd.type != NGTCP2_PKT_0RTT) {
-      ngtcp2_ksl_it_next(&it);
+      ngtcp2_rtb_it_next(&it);
       continue;
     }
 
     rtb_on_remove(rtb, ent, cstat);
-    rv = ngtcp2_ksl_remove_hint(&rtb->ents, &it, &it, &ent->hd.pkt_num);
-    assert(0 == rv);
+    rtb_remove_it(rtb, &it);
 
     ngtcp2_rtb_entry_objalloc_del(ent, rtb->rtb_entry_objalloc,
                                   rtb->frc_objalloc, rtb->mem);
@@ -1616,25 +2358,41 @@ void ngtcp2_rtb_remove_early_data(ngtcp2_rtb *rtb, ngtcp2_conn_stat *cstat) {
 }
 
 int ngtcp2_rtb_empty(ngtcp2_rtb *rtb) {
-  return ngtcp2_ksl_len(&rtb->ents) == 0;
+  return rtb->ents.len == 0;
 }
 
 void ngtcp2_rtb_reset_cc_state(ngtcp2_rtb *rtb, int64_t cc_pkt_num) {
   rtb->cc_pkt_num = cc_pkt_num;
   rtb->cc_bytes_in_flight = 0;
+
+  rtb_reorder_reset(rtb);
 }
 
 ngtcp2_ssize ngtcp2_rtb_reclaim_on_pto(ngtcp2_rtb *rtb, ngtcp2_conn *conn,
-                                       ngtcp2_pktns *pktns, size_t num_pkts) {
-  ngtcp2_ksl_it it;
+                                       ngtcp2_pktns *pktns, size_t num_pkts,
+                                       int latest) {
+  ngtcp2_rtb_it it;
   ngtcp2_rtb_entry *ent;
   ngtcp2_ssize reclaimed;
   size_t atmost = num_pkts;
 
-  it = ngtcp2_ksl_end(&rtb->ents);
-  for (; !ngtcp2_ksl_it_begin(&it) && num_pkts >= 1;) {
-    ngtcp2_ksl_it_prev(&it);
-    ent = ngtcp2_ksl_it_get(&it);
+  it = latest ? ngtcp2_rtb_head(rtb) : ngtcp2_rtb_end(rtb);
+  for (; num_pkts >= 1;) {
+    if (latest) {
+      if (ngtcp2_rtb_it_end(&it)) {
+        break;
+      }
+
+      ent = ngtcp2_rtb_it_get(&it);
+      ngtcp2_rtb_it_next(&it);
+    } else {
+      if (ngtcp2_rtb_it_begin(&it)) {
+        break;
+      }
+
+      ngtcp2_rtb_it_prev(&it);
+      ent = ngtcp2_rtb_it_get(&it);
+    }
 
     if ((ent->flags & (NGTCP2_RTB_ENTRY_FLAG_LOST_RETRANSMITTED |
                        NGTCP2_RTB_ENTRY_FLAG_PTO_RECLAIMED)) ||
@@ -69,6 +69,22 @@ int ngtcp2_frame_chain_binder_new(ngtcp2_frame_chain_binder **pbinder,
 
 typedef struct ngtcp2_frame_chain ngtcp2_frame_chain;
 
+/* NGTCP2_FRAME_CHAIN_SIZE_CLASS_BASE indicates that
+   ngtcp2_frame_chain has no extra space after ngtcp2_frame, and is
+   pooled by ngtcp2_objalloc. */
+#define NGTCP2_FRAME_CHAIN_SIZE_CLASS_BASE 0
+/* NGTCP2_FRAME_CHAIN_SIZE_CLASS_DATACNT4 indicates that
+   ngtcp2_frame_chain has enough space to store ngtcp2_stream with 4
+   ngtcp2_vec, and is pooled by ngtcp2_objalloc. */
+#define NGTCP2_FRAME_CHAIN_SIZE_CLASS_DATACNT4 1
+/* NGTCP2_FRAME_CHAIN_SIZE_CLASS_DATACNT8 indicates that
+   ngtcp2_frame_chain has enough space to store ngtcp2_stream with 8
+   ngtcp2_vec, and is pooled by ngtcp2_objalloc. */
+#define NGTCP2_FRAME_CHAIN_SIZE_CLASS_DATACNT8 2
+/* NGTCP2_FRAME_CHAIN_SIZE_CLASS_HEAP indicates that
+   ngtcp2_frame_chain is allocated by ngtcp2_mem_malloc. */
+#define NGTCP2_FRAME_CHAIN_SIZE_CLASS_HEAP 0xffu
+
 /*
  * ngtcp2_frame_chain chains frames in a single packet.
  */
@@ -77,6 +93,10 @@ struct ngtcp2_frame_chain {
     struct {
       ngtcp2_frame_chain *next;
       ngtcp2_frame_chain_binder *binder;
+      /* size_class is one of NGTCP2_FRAME_CHAIN_SIZE_CLASS_*.  It
+         tells how this object was allocated.  It does not change
+         even if the frame shrinks. */
+      uint8_t size_class;
       ngtcp2_frame fr;
     };
 
@@ -135,12 +155,23 @@ int ngtcp2_frame_chain_objalloc_new(ngtcp2_frame_chain **pfrc,
 int ngtcp2_frame_chain_extralen_new(ngtcp2_frame_chain **pfrc, size_t extralen,
                                     const ngtcp2_mem *mem);
 
+/*
+ * ngtcp2_frame_chain_extralen_objalloc_new works like
+ * ngtcp2_frame_chain_extralen_new, but it uses |objalloc| to allocate
+ * the object if |extralen| fits in one of the size classes.
+ * Otherwise, ngtcp2_frame_chain_extralen_new is called internally.
+ */
+int ngtcp2_frame_chain_extralen_objalloc_new(ngtcp2_frame_chain **pfrc,
+                                             size_t extralen,
+                                             ngtcp2_objalloc *objalloc,
+                                             const ngtcp2_mem *mem);
+
 /*
  * ngtcp2_frame_chain_stream_datacnt_objalloc_new works like
  * ngtcp2_frame_chain_new, but it allocates enough data to store
  * additional |datacnt| - 1 ngtcp2_vec object after ngtcp2_stream
- * object.  If no additional space is required,
- * ngtcp2_frame_chain_objalloc_new is called internally.
+ * object.  The object is taken from |objalloc| unless |datacnt|
+ * exceeds the largest size class.
  */
 int ngtcp2_frame_chain_stream_datacnt_objalloc_new(ngtcp2_frame_chain **pfrc,
                                                    size_t datacnt,
@@ -151,8 +182,8 @@ int ngtcp2_frame_chain_stream_datacnt_objalloc_new(ngtcp2_frame_chain **pfrc,
  * ngtcp2_frame_chain_crypto_datacnt_objalloc_new works like
  * ngtcp2_frame_chain_new, but it allocates enough data to store
  * additional |datacnt| - 1 ngtcp2_vec object after ngtcp2_crypto
- * object.  If no additional space is required,
- * ngtcp2_frame_chain_objalloc_new is called internally.
+ * object.  The object is taken from |objalloc| unless |datacnt|
+ * exceeds the largest size class.
  */
 int ngtcp2_frame_chain_crypto_datacnt_objalloc_new(ngtcp2_frame_chain **pfrc,
                                                    size_t datacnt,
@@ -172,8 +203,7 @@ void ngtcp2_frame_chain_del(ngtcp2_frame_chain *frc, const ngtcp2_mem *mem);
 
 /*
  * ngtcp2_frame_chain_objalloc_del adds |frc| to |objalloc| for reuse.
- * It might just delete |frc| depending on the frame type and the size
- * of |frc|.
+ * It just deletes |frc| if it was not allocated from |objalloc|.
  */
 void ngtcp2_frame_chain_objalloc_del(ngtcp2_frame_chain *frc,
                                      ngtcp2_objalloc *objalloc,
@@ -186,13 +216,51 @@ void ngtcp2_frame_chain_init(ngtcp2_frame_chain *frc);
 
 /*
  * ngtcp2_frame_chain_list_objalloc_del adds all ngtcp2_frame_chain
- * linked from |frc| to |objalloc| for reuse.  Depending on the frame type
- * and its size, ngtcp2_frame_chain might be deleted instead.
+ * linked from |frc| to |objalloc| for reuse.  ngtcp2_frame_chain
+ * which was not allocated from |objalloc| is deleted instead.
  */
 void ngtcp2_frame_chain_list_objalloc_del(ngtcp2_frame_chain *frc,
                                           ngtcp2_objalloc *objalloc,
                                           const ngtcp2_mem *mem);
 
+/*
+ * ngtcp2_cryptofrq is the queue of CRYPTO frames to send, sorted by
+ * their offset.  The frames are linked by ngtcp2_frame_chain.next.
+ * Newly submitted data is always appended, and the frames to
+ * retransmit are usually few, so that a linked list with the tail
+ * pointer suffices.
+ */
+typedef struct ngtcp2_cryptofrq {
+  ngtcp2_frame_chain *head;
+  ngtcp2_frame_chain *tail;
+  /* len is the number of frames in the queue. */
+  size_t len;
+} ngtcp2_cryptofrq;
+
+/*
+ * ngtcp2_cryptofrq_init initializes |frq|.
+ */
+void ngtcp2_cryptofrq_init(ngtcp2_cryptofrq *frq);
+
+/*
+ * ngtcp2_cryptofrq_push inserts |frc| which contains CRYPTO frame to
+ * |frq| in the order of its offset.  If there are frames with the
+ * same offset, |frc| is placed after them.
+ */
+void ngtcp2_cryptofrq_push(ngtcp2_cryptofrq *frq, ngtcp2_frame_chain *frc);
+
+/*
+ * ngtcp2_cryptofrq_pop removes the first frame from |frq| and returns
+ * it.  |frq| must not be empty.
+ */
+ngtcp2_frame_chain *ngtcp2_cryptofrq_pop(ngtcp2_cryptofrq *frq);
+
+/*
+ * ngtcp2_cryptofrq_clear deletes all frames in |frq|.
+ */
+void ngtcp2_cryptofrq_clear(ngtcp2_cryptofrq *frq, ngtcp2_objalloc *objalloc,
+                            const ngtcp2_mem *mem);
+
 /* NGTCP2_RTB_ENTRY_FLAG_NONE indicates that no flag is set. */
 #define NGTCP2_RTB_ENTRY_FLAG_NONE 0x00u
 /* NGTCP2_RTB_ENTRY_FLAG_PROBE indicates that the entry includes a
@@ -290,6 +358,51 @@ void ngtcp2_rtb_entry_objalloc_del(ngtcp2_rtb_entry *ent,
                                    ngtcp2_objalloc *frc_objalloc,
                                    const ngtcp2_mem *mem);
 
+/* NGTCP2_RTB_ENTS_INITIAL_CAP is the number of slots that
+   ngtcp2_rtb_ents allocates when the first entry is added. */
+#define NGTCP2_RTB_ENTS_INITIAL_CAP 64
+
+/* NGTCP2_RTB_ENTS_MAX_CAP is the largest number of slots that
+   ngtcp2_rtb_ents allocates. */
+#ifndef LOWMEMORY
+#  define NGTCP2_RTB_ENTS_MAX_CAP 16384
+#else /* LOWMEMORY */
+#  define NGTCP2_RTB_ENTS_MAX_CAP 1024
+#endif /* LOWMEMORY */
+
+/*
+ * ngtcp2_rtb_ents is a growable ring of ngtcp2_rtb_entry indexed by
+ * packet number.  An entry of packet number p is stored at slots[p &
+ * (cap - 1)].  Because packet numbers are allocated sequentially,
+ * the occupied range [base, last] is dense, and adding, finding, and
+ * removing an entry is O(1).  Slots for the packet numbers which have
+ * been removed, or skipped, are NULL.
+ *
+ * An old packet which stays in the ring widens the range without
+ * adding entries.  If the range exceeds NGTCP2_RTB_ENTS_MAX_CAP, the
+ * entries are moved to the skip list sparse, and they are moved back
+ * once the range is half of it.  The ring also shrinks as the range
+ * narrows.
+ */
+typedef struct ngtcp2_rtb_ents {
+  ngtcp2_rtb_entry **slots;
+  /* cap is the number of slots.  It is 0 or a power of 2. */
+  size_t cap;
+  /* sparse contains the entries in the decreasing order of packet
+     number instead of slots if use_sparse is nonzero. */
+  ngtcp2_ksl sparse;
+  /* base is the smallest packet number.  It is only meaningful if
+     len > 0. */
+  int64_t base;
+  /* last is the largest packet number.  It is only meaningful if len
+     > 0. */
+  int64_t last;
+  /* len is the number of entries. */
+  size_t len;
+  /* use_sparse is nonzero if the entries are stored in sparse. */
+  int use_sparse;
+} ngtcp2_rtb_ents;
+
 /*
  * ngtcp2_rtb tracks sent packets, and its ACK timeout for
  * retransmission.
@@ -297,9 +410,8 @@ void ngtcp2_rtb_entry_objalloc_del(ngtcp2_rtb_entry *ent,
 typedef struct ngtcp2_rtb {
   ngtcp2_objalloc *frc_objalloc;
   ngtcp2_objalloc *rtb_entry_objalloc;
-  /* ents includes ngtcp2_rtb_entry sorted by decreasing order of
-     packet number. */
-  ngtcp2_ksl ents;
+  /* ents includes ngtcp2_rtb_entry indexed by packet number. */
+  ngtcp2_rtb_ents ents;
   /* crypto is CRYPTO stream. */
   ngtcp2_strm *crypto;
   ngtcp2_rst *rst;
@@ -340,8 +452,48 @@ typedef struct ngtcp2_rtb {
      both NGTCP2_RTB_ENTRY_FLAG_LOST_RETRANSMITTED and
      NGTCP2_RTB_ENTRY_FLAG_PMTUD_PROBE flags set. */
   size_t num_lost_pmtud_pkts;
+  /* reorder contains the reordering tolerance learned from the
+     packets which are acknowledged after they are declared lost. */
+  struct {
+    /* pkt_thres is the packet threshold of loss detection.  It is at
+       least NGTCP2_PKT_THRESHOLD. */
+    size_t pkt_thres;
+    /* wnd_mult is the number of min_rtt / 4 added to the time
+       threshold of loss detection. */
+    size_t wnd_mult;
+    /* wnd_persist is the number of loss recoveries left before
+       pkt_thres and wnd_mult are reset. */
+    size_t wnd_persist;
+    /* next_ts is the earliest time when wnd_mult can be increased
+       again, so that it grows at most once per round trip. */
+    ngtcp2_tstamp next_ts;
+  } reorder;
 } ngtcp2_rtb;
 
+/*
+ * ngtcp2_rtb_it is an iterator over ngtcp2_rtb_entry in ngtcp2_rtb.
+ * It visits entries in decreasing order of packet number.
+ */
+typedef struct ngtcp2_rtb_it {
+  ngtcp2_rtb *rtb;
+  /* pkt_num is the packet number of the entry that this iterator
+     points to.  It is -1 if this iterator points to the end. */
+  int64_t pkt_num;
+  /* ent is the entry that this iterator points to.  It is NULL if
+     this iterator points to the end. */
+  ngtcp2_rtb_entry *ent;
+} ngtcp2_rtb_it;
+
+/*
+ * ngtcp2_rtb_it_get returns the entry pointed by |IT|.
+ */
+#define ngtcp2_rtb_it_get(IT) ((IT)->ent)
+
+/*
+ * ngtcp2_rtb_it_end returns nonzero if |IT| points to the end.
+ */
+#define ngtcp2_rtb_it_end(IT) ((IT)->pkt_num == -1)
+
 /*
  * ngtcp2_rtb_init initializes |rtb|.
  */
@@ -371,9 +523,45 @@ int ngtcp2_rtb_add(ngtcp2_rtb *rtb, ngtcp2_rtb_entry *ent,
 /*
  * ngtcp2_rtb_head returns the iterator which points to the entry
  * which has the largest packet number.  If there is no entry,
- * returned value satisfies ngtcp2_ksl_it_end(&it) != 0.
+ * returned value satisfies ngtcp2_rtb_it_end(&it) != 0.
+ */
+ngtcp2_rtb_it ngtcp2_rtb_head(ngtcp2_rtb *rtb);
+
+/*
+ * ngtcp2_rtb_end returns the iterator which points to the position
+ * past the entry which has the smallest packet number.
+ * ngtcp2_rtb_it_prev on the returned iterator moves it to the entry
+ * which has the smallest packet number.
+ */
+ngtcp2_rtb_it ngtcp2_rtb_end(ngtcp2_rtb *rtb);
+
+/*
+ * ngtcp2_rtb_lower_bound returns the iterator which points to the
+ * entry which has the largest packet number that is equal to or
+ * less than |pkt_num|.  If there is no such entry, returned value
+ * satisfies ngtcp2_rtb_it_end(&it) != 0.
+ */
+ngtcp2_rtb_it ngtcp2_rtb_lower_bound(ngtcp2_rtb *rtb, int64_t pkt_num);
+
+/*
+ * ngtcp2_rtb_it_next advances |it| to the entry which has the next
+ * smaller packet number.  |it| must not be an end iterator.
+ */
+void ngtcp2_rtb_it_next(ngtcp2_rtb_it *it);
+
+/*
+ * ngtcp2_rtb_it_prev moves |it| to the entry which has the next
+ * larger packet number.  If |it| is an end iterator, it moves to the
+ * entry which has the smallest packet number.  ngtcp2_rtb_it_begin
+ * must return 0 for |it|.
+ */
+void ngtcp2_rtb_it_prev(ngtcp2_rtb_it *it);
+
+/*
+ * ngtcp2_rtb_it_begin returns nonzero if |it| points to the entry
+ * which has the largest packet number, or there is no entry.
  */
-ngtcp2_ksl_it ngtcp2_rtb_head(ngtcp2_rtb *rtb);
+int ngtcp2_rtb_it_begin(const ngtcp2_rtb_it *it);
 
 /*
  * ngtcp2_rtb_recv_ack removes acked ngtcp2_rtb_entry from |rtb|.
@@ -437,7 +625,8 @@ void ngtcp2_rtb_remove_early_data(ngtcp2_rtb *rtb, ngtcp2_conn_stat *cstat);
 int ngtcp2_rtb_empty(ngtcp2_rtb *rtb);
 
 /*
- * ngtcp2_rtb_reset_cc_state resets congestion state in |rtb|.
+ * ngtcp2_rtb_reset_cc_state resets congestion state in |rtb|,
+ * including the reordering tolerance learned on the previous path.
  * |cc_pkt_num| is the next outbound packet number which is sent under
  * new congestion state.
  */
@@ -452,7 +641,9 @@ void ngtcp2_rtb_remove_excessive_lost_pkt(ngtcp2_rtb *rtb, size_t n);
 /*
  * ngtcp2_rtb_reclaim_on_pto reclaims up to |num_pkts| packets which
  * are in-flight and not marked lost to send them in PTO probe.  The
- * reclaimed frames are chained to |*pfrc|.
+ * reclaimed frames are chained to |*pfrc|.  If |latest| is nonzero,
+ * the packets are reclaimed from the largest packet number, otherwise
+ * from the smallest one.
  *
  * This function returns the number of packets reclaimed if it
  * succeeds, or one of the following negative error codes:
@@ -461,6 +652,7 @@ void ngtcp2_rtb_remove_excessive_lost_pkt(ngtcp2_rtb *rtb, size_t n);
  *     Out of memory
  */
 ngtcp2_ssize ngtcp2_rtb_reclaim_on_pto(ngtcp2_rtb *rtb, ngtcp2_conn *conn,
-                                       ngtcp2_pktns *pktns, size_t num_pkts);
+                                       ngtcp2_pktns *pktns, size_t num_pkts,
+                                       int latest);
 
 #endif /* NGTCP2_RTB_H */
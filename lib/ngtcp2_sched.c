@@ -0,0 +1,191 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_sched.h"
+
+#include <assert.h>
+
+#include "ngtcp2_strm.h"
+#include "ngtcp2_macro.h"
+
+/*
+ * sched_vtime_less compares the virtual time of |ls| and |rs|, and
+ * breaks tie by stream ID.
+ */
+static int sched_vtime_less(const ngtcp2_strm *ls, const ngtcp2_strm *rs) {
+  if (ls->sched.vtime == rs->sched.vtime) {
+    return ls->stream_id < rs->stream_id;
+  }
+
+  return ls->sched.vtime < rs->sched.vtime;
+}
+
+static int rr_less(const ngtcp2_pq_entry *lhs, const ngtcp2_pq_entry *rhs) {
+  return sched_vtime_less(ngtcp2_struct_of(lhs, ngtcp2_strm, sched.pe),
+                          ngtcp2_struct_of(rhs, ngtcp2_strm, sched.pe));
+}
+
+static void rr_advance(ngtcp2_strm *strm, size_t datalen) {
+  (void)datalen;
+
+  ++strm->sched.vtime;
+}
+
+/*
+ * wfq_advance charges |strm| |datalen| bytes scaled by the inverse of
+ * its weight, so that the streams share the bandwidth in proportion
+ * to their weight.
+ */
+static void wfq_advance(ngtcp2_strm *strm, size_t datalen) {
+  uint64_t cost = (uint64_t)datalen * NGTCP2_MAX_STREAM_WEIGHT /
+                  strm->sched.weight;
+
+  strm->sched.vtime += ngtcp2_max(cost, 1);
+}
+
+/*
+ * strict_less serves the streams of lower urgency first.  The streams
+ * of the same urgency are ordered by virtual time.
+ */
+static int strict_less(const ngtcp2_pq_entry *lhs,
+                       const ngtcp2_pq_entry *rhs) {
+  ngtcp2_strm *ls = ngtcp2_struct_of(lhs, ngtcp2_strm, sched.pe);
+  ngtcp2_strm *rs = ngtcp2_struct_of(rhs, ngtcp2_strm, sched.pe);
+
+  if (ls->sched.urgency != rs->sched.urgency) {
+    return ls->sched.urgency < rs->sched.urgency;
+  }
+
+  return sched_vtime_less(ls, rs);
+}
+
+/*
+ * strict_advance only advances the virtual time of incremental
+ * stream.  Non-incremental stream keeps its position, and sends all
+ * of its data before the streams following it as RFC 9218 suggests.
+ */
+static void strict_advance(ngtcp2_strm *strm, size_t datalen) {
+  (void)datalen;
+
+  if (strm->sched.incremental) {
+    ++strm->sched.vtime;
+  }
+}
+
+static const ngtcp2_sched_ops sched_ops[] = {
+    /* NGTCP2_SCHED_POLICY_ROUND_ROBIN */
+    {rr_less, rr_advance},
+    /* NGTCP2_SCHED_POLICY_WEIGHTED_FAIR */
+    {rr_less, wfq_advance},
+    /* NGTCP2_SCHED_POLICY_STRICT_PRIORITY */
+    {strict_less, strict_advance},
+};
+
+void ngtcp2_sched_init(ngtcp2_sched *sched, ngtcp2_sched_policy policy,
+                       const ngtcp2_mem *mem) {
+  if ((size_t)policy >= sizeof(sched_ops) / sizeof(sched_ops[0])) {
+    policy = NGTCP2_SCHED_POLICY_ROUND_ROBIN;
+  }
+
+  sched->ops = &sched_ops[policy];
+
+  ngtcp2_pq_init(&sched->pq, sched->ops->less, mem);
+}
+
+void ngtcp2_sched_free(ngtcp2_sched *sched) { ngtcp2_pq_free(&sched->pq); }
+
+int ngtcp2_sched_push(ngtcp2_sched *sched, ngtcp2_strm *strm) {
+  ngtcp2_strm *top;
+  int rv;
+
+  if (ngtcp2_sched_is_queued(strm)) {
+    return 0;
+  }
+
+  if (!ngtcp2_pq_empty(&sched->pq)) {
+    top = ngtcp2_struct_of(ngtcp2_pq_top(&sched->pq), ngtcp2_strm, sched.pe);
+    strm->sched.vtime = ngtcp2_max(strm->sched.vtime, top->sched.vtime);
+  }
+
+  rv = ngtcp2_pq_push(&sched->pq, &strm->sched.pe);
+  if (rv != 0) {
+    return rv;
+  }
+
+  return 0;
+}
+
+void ngtcp2_sched_remove(ngtcp2_sched *sched, ngtcp2_strm *strm) {
+  if (!ngtcp2_sched_is_queued(strm)) {
+    return;
+  }
+
+  ngtcp2_pq_remove(&sched->pq, &strm->sched.pe);
+  strm->sched.pe.index = NGTCP2_PQ_BAD_INDEX;
+}
+
+ngtcp2_strm *ngtcp2_sched_top(ngtcp2_sched *sched) {
+  if (ngtcp2_pq_empty(&sched->pq)) {
+    return NULL;
+  }
+
+  return ngtcp2_struct_of(ngtcp2_pq_top(&sched->pq), ngtcp2_strm, sched.pe);
+}
+
+/*
+ * sched_requeue moves |strm| to the right position after its key
+ * changed.  Removing an entry never shrinks the queue, so that the
+ * following push does not fail.
+ */
+static void sched_requeue(ngtcp2_sched *sched, ngtcp2_strm *strm) {
+  int rv;
+
+  ngtcp2_pq_remove(&sched->pq, &strm->sched.pe);
+
+  rv = ngtcp2_pq_push(&sched->pq, &strm->sched.pe);
+
+  assert(0 == rv);
+  (void)rv;
+}
+
+void ngtcp2_sched_update(ngtcp2_sched *sched, ngtcp2_strm *strm,
+                         size_t datalen) {
+  assert(ngtcp2_sched_is_queued(strm));
+
+  sched->ops->advance(strm, datalen);
+
+  sched_requeue(sched, strm);
+}
+
+void ngtcp2_sched_reprioritize(ngtcp2_sched *sched, ngtcp2_strm *strm) {
+  if (!ngtcp2_sched_is_queued(strm)) {
+    return;
+  }
+
+  sched_requeue(sched, strm);
+}
+
+int ngtcp2_sched_is_queued(const ngtcp2_strm *strm) {
+  return strm->sched.pe.index != NGTCP2_PQ_BAD_INDEX;
+}
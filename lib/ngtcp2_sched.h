@@ -0,0 +1,121 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGTCP2_SCHED_H
+#define NGTCP2_SCHED_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <ngtcp2/ngtcp2.h>
+
+#include "ngtcp2_pq.h"
+#include "ngtcp2_mem.h"
+
+typedef struct ngtcp2_strm ngtcp2_strm;
+
+/*
+ * ngtcp2_sched_ops is the set of functions which implements a
+ * scheduling policy.
+ */
+typedef struct ngtcp2_sched_ops {
+  /* less orders the streams in the queue.  The stream at the top is
+     the next stream to send data. */
+  ngtcp2_less less;
+  /* advance updates the virtual time of |strm| after it sends
+     |datalen| bytes of data. */
+  void (*advance)(ngtcp2_strm *strm, size_t datalen);
+} ngtcp2_sched_ops;
+
+/*
+ * ngtcp2_sched is a stream scheduler which decides the order in
+ * which the streams that have new data send it.  The streams are
+ * ordered by the virtual time which is advanced as they send data,
+ * and the rule is given by ngtcp2_sched_ops of the chosen policy.
+ */
+typedef struct ngtcp2_sched {
+  ngtcp2_pq pq;
+  const ngtcp2_sched_ops *ops;
+} ngtcp2_sched;
+
+/*
+ * ngtcp2_sched_init initializes |sched| with |policy|.  If |policy|
+ * is unknown, NGTCP2_SCHED_POLICY_ROUND_ROBIN is used.
+ */
+void ngtcp2_sched_init(ngtcp2_sched *sched, ngtcp2_sched_policy policy,
+                       const ngtcp2_mem *mem);
+
+/*
+ * ngtcp2_sched_free frees resources allocated for |sched|.  It does
+ * not free the streams in the queue.
+ */
+void ngtcp2_sched_free(ngtcp2_sched *sched);
+
+/*
+ * ngtcp2_sched_push queues |strm| if it is not queued yet.  The
+ * virtual time of |strm| is brought forward to the one of the stream
+ * at the top so that the stream which has been idle cannot take over
+ * the others.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory.
+ */
+int ngtcp2_sched_push(ngtcp2_sched *sched, ngtcp2_strm *strm);
+
+/*
+ * ngtcp2_sched_remove removes |strm| from |sched| if it is queued.
+ */
+void ngtcp2_sched_remove(ngtcp2_sched *sched, ngtcp2_strm *strm);
+
+/*
+ * ngtcp2_sched_top returns the stream at the top of |sched|, or NULL
+ * if |sched| is empty.
+ */
+ngtcp2_strm *ngtcp2_sched_top(ngtcp2_sched *sched);
+
+/*
+ * ngtcp2_sched_update advances the virtual time of |strm| which is
+ * queued in |sched| after it sent |datalen| bytes of data, and moves
+ * it to the new position.
+ */
+void ngtcp2_sched_update(ngtcp2_sched *sched, ngtcp2_strm *strm,
+                         size_t datalen);
+
+/*
+ * ngtcp2_sched_reprioritize moves |strm| to the right position after
+ * its priority has been changed.
+ */
+void ngtcp2_sched_reprioritize(ngtcp2_sched *sched, ngtcp2_strm *strm);
+
+/*
+ * ngtcp2_sched_is_queued returns nonzero if |strm| is queued in a
+ * scheduler.
+ */
+int ngtcp2_sched_is_queued(const ngtcp2_strm *strm);
+
+#endif /* NGTCP2_SCHED_H */
@@ -0,0 +1,88 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_seqlock.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#  define seqlock_load(P) __atomic_load_n((P), __ATOMIC_RELAXED)
+#  define seqlock_store(P, N) __atomic_store_n((P), (N), __ATOMIC_RELAXED)
+#  define seqlock_acquire_fence() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#  define seqlock_release_fence() __atomic_thread_fence(__ATOMIC_RELEASE)
+#elif defined(_MSC_VER)
+#  include <intrin.h>
+/* The aligned 32 bit volatile access is atomic. */
+#  define seqlock_load(P) (*(const volatile uint32_t *)(P))
+#  define seqlock_store(P, N) (*(volatile uint32_t *)(P) = (N))
+#  if defined(_M_ARM64)
+#    define seqlock_acquire_fence() __dmb(_ARM64_BARRIER_ISH)
+#    define seqlock_release_fence() __dmb(_ARM64_BARRIER_ISH)
+#  else /* !defined(_M_ARM64) */
+/* x86 does not reorder a load with the other loads, or a store with
+   the other stores, so preventing the compiler from doing so is
+   enough. */
+#    define seqlock_acquire_fence() _ReadWriteBarrier()
+#    define seqlock_release_fence() _ReadWriteBarrier()
+#  endif /* !defined(_M_ARM64) */
+#else /* !(defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER)) */
+#  include <stdatomic.h>
+#  define seqlock_load(P) (*(const volatile uint32_t *)(P))
+#  define seqlock_store(P, N) (*(volatile uint32_t *)(P) = (N))
+#  define seqlock_acquire_fence() atomic_thread_fence(memory_order_acquire)
+#  define seqlock_release_fence() atomic_thread_fence(memory_order_release)
+#endif /* !(defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER)) */
+
+void ngtcp2_seqlock_init(ngtcp2_seqlock *lock) { lock->seq = 0; }
+
+void ngtcp2_seqlock_write_begin(ngtcp2_seqlock *lock) {
+  seqlock_store(&lock->seq, lock->seq + 1);
+  /* The readers must see the odd sequence number before any update
+     of the data. */
+  seqlock_release_fence();
+}
+
+void ngtcp2_seqlock_write_end(ngtcp2_seqlock *lock) {
+  seqlock_release_fence();
+  seqlock_store(&lock->seq, lock->seq + 1);
+}
+
+uint32_t ngtcp2_seqlock_read_begin(const ngtcp2_seqlock *lock) {
+  uint32_t seq;
+
+  for (;;) {
+    seq = seqlock_load(&lock->seq);
+    if (!(seq & 1)) {
+      break;
+    }
+  }
+
+  seqlock_acquire_fence();
+
+  return seq;
+}
+
+int ngtcp2_seqlock_read_retry(const ngtcp2_seqlock *lock, uint32_t seq) {
+  seqlock_acquire_fence();
+
+  return seqlock_load(&lock->seq) != seq;
+}
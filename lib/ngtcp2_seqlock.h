@@ -0,0 +1,76 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGTCP2_SEQLOCK_H
+#define NGTCP2_SEQLOCK_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <ngtcp2/ngtcp2.h>
+
+/*
+ * ngtcp2_seqlock is a sequence lock.  A single writer updates the
+ * data which it protects without waiting, and any number of readers
+ * on the other threads read it without taking a lock.  A reader
+ * retries if the writer updated the data in the middle of the read.
+ * seq is odd while the writer is updating the data.
+ */
+typedef struct ngtcp2_seqlock {
+  uint32_t seq;
+} ngtcp2_seqlock;
+
+/*
+ * ngtcp2_seqlock_init initializes |lock|.
+ */
+void ngtcp2_seqlock_init(ngtcp2_seqlock *lock);
+
+/*
+ * ngtcp2_seqlock_write_begin tells that the writer starts updating
+ * the data protected by |lock|.
+ */
+void ngtcp2_seqlock_write_begin(ngtcp2_seqlock *lock);
+
+/*
+ * ngtcp2_seqlock_write_end tells that the writer has finished
+ * updating the data protected by |lock|.
+ */
+void ngtcp2_seqlock_write_end(ngtcp2_seqlock *lock);
+
+/*
+ * ngtcp2_seqlock_read_begin waits until no update is in progress, and
+ * returns the sequence number to pass to ngtcp2_seqlock_read_retry
+ * after the data protected by |lock| is read.
+ */
+uint32_t ngtcp2_seqlock_read_begin(const ngtcp2_seqlock *lock);
+
+/*
+ * ngtcp2_seqlock_read_retry returns nonzero if the data protected by
+ * |lock| might have been updated since ngtcp2_seqlock_read_begin
+ * returned |seq|, in which case the data read must be discarded.
+ */
+int ngtcp2_seqlock_read_retry(const ngtcp2_seqlock *lock, uint32_t seq);
+
+#endif /* NGTCP2_SEQLOCK_H */
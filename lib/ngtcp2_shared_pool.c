@@ -0,0 +1,103 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_shared_pool.h"
+
+#include <string.h>
+#include <assert.h>
+
+#include "ngtcp2_rtb.h"
+#include "ngtcp2_conn.h"
+
+int ngtcp2_shared_pool_new(ngtcp2_shared_pool **ppool, size_t max_cached,
+                           const ngtcp2_mem *mem) {
+  ngtcp2_shared_pool *pool;
+
+  if (max_cached == 0) {
+    return NGTCP2_ERR_INVALID_ARGUMENT;
+  }
+
+  if (mem == NULL) {
+    mem = ngtcp2_mem_default();
+  }
+
+  pool = ngtcp2_mem_malloc(mem, sizeof(*pool));
+  if (pool == NULL) {
+    return NGTCP2_ERR_NOMEM;
+  }
+
+  ngtcp2_objalloc_frame_chain_heap_init(&pool->frc, max_cached, mem);
+  ngtcp2_objalloc_rtb_entry_heap_init(&pool->rtb_entry, max_cached, mem);
+  ngtcp2_objalloc_strm_heap_init(&pool->strm, max_cached, mem);
+  pool->mem = mem;
+
+  *ppool = pool;
+
+  return 0;
+}
+
+void ngtcp2_shared_pool_del(ngtcp2_shared_pool *pool) {
+  if (pool == NULL) {
+    return;
+  }
+
+  assert(pool->frc.nused == 0);
+  assert(pool->rtb_entry.nused == 0);
+  assert(pool->strm.nused == 0);
+
+  ngtcp2_objalloc_free(&pool->strm);
+  ngtcp2_objalloc_free(&pool->rtb_entry);
+  ngtcp2_objalloc_free(&pool->frc);
+
+  ngtcp2_mem_free(pool->mem, pool);
+}
+
+/*
+ * add_objalloc_stat adds the statistics of |objalloc| to |stat|.
+ */
+static void add_objalloc_stat(ngtcp2_shared_pool_stat *stat,
+                              const ngtcp2_objalloc *objalloc) {
+  stat->in_use += objalloc->nused;
+  stat->cached += objalloc->ncached;
+  stat->reused += objalloc->nreused;
+  stat->allocated += objalloc->nallocated;
+}
+
+void ngtcp2_shared_pool_get_stat_versioned(const ngtcp2_shared_pool *pool,
+                                           int shared_pool_stat_version,
+                                           ngtcp2_shared_pool_stat *stat) {
+  (void)shared_pool_stat_version;
+
+  memset(stat, 0, sizeof(*stat));
+
+  add_objalloc_stat(stat, &pool->frc);
+  add_objalloc_stat(stat, &pool->rtb_entry);
+  add_objalloc_stat(stat, &pool->strm);
+}
+
+void ngtcp2_shared_pool_trim(ngtcp2_shared_pool *pool) {
+  ngtcp2_objalloc_shrink(&pool->frc);
+  ngtcp2_objalloc_shrink(&pool->rtb_entry);
+  ngtcp2_objalloc_shrink(&pool->strm);
+}
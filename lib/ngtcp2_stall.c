@@ -0,0 +1,46 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_stall.h"
+
+#include <string.h>
+
+void ngtcp2_stall_init(ngtcp2_stall *stall) {
+  memset(stall, 0, sizeof(*stall));
+  stall->last_ts = UINT64_MAX;
+}
+
+int ngtcp2_stall_update(ngtcp2_stall *stall, ngtcp2_stall_cause cause,
+                        ngtcp2_tstamp ts) {
+  ngtcp2_stall_cause prev = stall->cause;
+
+  if (stall->last_ts != UINT64_MAX && ts > stall->last_ts) {
+    stall->duration[prev] += ts - stall->last_ts;
+  }
+
+  stall->last_ts = ts;
+  stall->cause = cause;
+
+  return prev != cause;
+}
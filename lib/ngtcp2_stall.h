@@ -0,0 +1,74 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGTCP2_STALL_H
+#define NGTCP2_STALL_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <ngtcp2/ngtcp2.h>
+
+/* ngtcp2_stall_cause is the reason why a connection could not send a
+   packet when it was asked to. */
+typedef enum ngtcp2_stall_cause {
+  /* NGTCP2_STALL_CAUSE_NONE indicates that a packet was sent, and the
+     time is not counted. */
+  NGTCP2_STALL_CAUSE_NONE,
+  NGTCP2_STALL_CAUSE_CWND,
+  NGTCP2_STALL_CAUSE_PACING,
+  NGTCP2_STALL_CAUSE_CONN_FLOW_CONTROL,
+  NGTCP2_STALL_CAUSE_STREAM_FLOW_CONTROL,
+  NGTCP2_STALL_CAUSE_APP,
+  NGTCP2_STALL_CAUSE_MAX,
+} ngtcp2_stall_cause;
+
+/* ngtcp2_stall accumulates the time during which sending was limited
+   by each cause.  The cause observed by a write call is assumed to
+   hold until the next one. */
+typedef struct ngtcp2_stall {
+  /* duration is the total time spent limited by each cause. */
+  ngtcp2_duration duration[NGTCP2_STALL_CAUSE_MAX];
+  /* last_ts is the time when |cause| was last observed.  It is
+     UINT64_MAX if nothing has been observed yet. */
+  ngtcp2_tstamp last_ts;
+  /* cause is the cause observed last time. */
+  ngtcp2_stall_cause cause;
+} ngtcp2_stall;
+
+/*
+ * ngtcp2_stall_init initializes |stall|.
+ */
+void ngtcp2_stall_init(ngtcp2_stall *stall);
+
+/*
+ * ngtcp2_stall_update charges the time elapsed since the last update
+ * to the current cause, and makes |cause| current.  It returns
+ * nonzero if |cause| differs from the previous one.
+ */
+int ngtcp2_stall_update(ngtcp2_stall *stall, ngtcp2_stall_cause cause,
+                        ngtcp2_tstamp ts);
+
+#endif /* NGTCP2_STALL_H */
@@ -31,10 +31,6 @@
 #include "ngtcp2_pkt.h"
 #include "ngtcp2_vec.h"
 
-static int offset_less(const ngtcp2_ksl_key *lhs, const ngtcp2_ksl_key *rhs) {
-  return *(int64_t *)lhs < *(int64_t *)rhs;
-}
-
 void ngtcp2_strm_init(ngtcp2_strm *strm, int64_t stream_id, uint32_t flags,
                       uint64_t max_rx_offset, uint64_t max_tx_offset,
                       void *stream_user_data, ngtcp2_objalloc *frc_objalloc,
@@ -49,26 +45,89 @@ void ngtcp2_strm_init(ngtcp2_strm *strm, int64_t stream_id, uint32_t flags,
   strm->tx.last_max_stream_data_ts = UINT64_MAX;
   strm->tx.loss_count = 0;
   strm->tx.last_lost_pkt_num = -1;
+  strm->tx.acked_next = NULL;
+  strm->tx.acked_prev_offset = 0;
+  strm->tx.pending_ack_offset = 0;
+  strm->tx.pending_ack_len = 0;
+  strm->tx.bufs = NULL;
+  strm->tx.bufs_tail = &strm->tx.bufs;
+  strm->tx.buf_offset = 0;
+  strm->tx.sendbuf = NULL;
+  strm->tx.fec = NULL;
+  strm->tx.offer_ts = UINT64_MAX;
   strm->rx.rob = NULL;
   strm->rx.cont_offset = 0;
   strm->rx.last_offset = 0;
+  strm->rx.fec = NULL;
+  strm->rx.hol_ts = UINT64_MAX;
+  strm->rx.hol_start = UINT64_MAX;
+  memset(&strm->rx.hol, 0, sizeof(strm->rx.hol));
   strm->stream_id = stream_id;
   strm->flags = flags;
   strm->stream_user_data = stream_user_data;
   strm->rx.window = strm->rx.max_offset = strm->rx.unsent_max_offset =
       max_rx_offset;
   strm->pe.index = NGTCP2_PQ_BAD_INDEX;
+  strm->sched.pe.index = NGTCP2_PQ_BAD_INDEX;
+  strm->sched.vtime = 0;
+  strm->sched.weight = NGTCP2_DEFAULT_STREAM_WEIGHT;
+  strm->sched.urgency = NGTCP2_DEFAULT_URGENCY;
+  strm->sched.incremental = 0;
   strm->mem = mem;
+  strm->pool = NULL;
   strm->app_error_code = 0;
 }
 
+void ngtcp2_strm_pool_init(ngtcp2_strm_pool *pool) {
+  pool->nrob = 0;
+  pool->nstreamfrq = 0;
+  pool->nacked_offset = 0;
+}
+
+void ngtcp2_strm_pool_free(ngtcp2_strm_pool *pool, const ngtcp2_mem *mem) {
+  size_t i;
+
+  for (i = 0; i < pool->nrob; ++i) {
+    ngtcp2_rob_free(pool->rob[i]);
+    ngtcp2_mem_free(mem, pool->rob[i]);
+  }
+
+  for (i = 0; i < pool->nstreamfrq; ++i) {
+    ngtcp2_ksl_free(pool->streamfrq[i]);
+    ngtcp2_mem_free(mem, pool->streamfrq[i]);
+  }
+
+  for (i = 0; i < pool->nacked_offset; ++i) {
+    ngtcp2_gaptr_free(pool->acked_offset[i]);
+    ngtcp2_mem_free(mem, pool->acked_offset[i]);
+  }
+}
+
+static void strm_sendbuf_free(ngtcp2_strm_sendbuf *sendbuf,
+                              const ngtcp2_mem *mem) {
+  ngtcp2_strm_sendbuf_chunk *chunk, *next;
+
+  for (chunk = sendbuf->head; chunk;) {
+    next = chunk->next;
+    ngtcp2_mem_free(mem, chunk);
+    chunk = next;
+  }
+
+  ngtcp2_mem_free(mem, sendbuf->spare);
+  ngtcp2_mem_free(mem, sendbuf);
+}
+
 void ngtcp2_strm_free(ngtcp2_strm *strm) {
   ngtcp2_ksl_it it;
+  ngtcp2_strm_buf *buf, *next;
+  ngtcp2_strm_pool *pool;
 
   if (strm == NULL) {
     return;
   }
 
+  pool = strm->pool;
+
   if (strm->tx.streamfrq) {
     for (it = ngtcp2_ksl_begin(strm->tx.streamfrq); !ngtcp2_ksl_it_end(&it);
          ngtcp2_ksl_it_next(&it)) {
@@ -76,30 +135,90 @@ void ngtcp2_strm_free(ngtcp2_strm *strm) {
                                       strm->frc_objalloc, strm->mem);
     }
 
-    ngtcp2_ksl_free(strm->tx.streamfrq);
-    ngtcp2_mem_free(strm->mem, strm->tx.streamfrq);
+    if (pool && pool->nstreamfrq < NGTCP2_STRM_POOL_MAX) {
+      ngtcp2_ksl_reset(strm->tx.streamfrq);
+      pool->streamfrq[pool->nstreamfrq++] = strm->tx.streamfrq;
+    } else {
+      ngtcp2_ksl_free(strm->tx.streamfrq);
+      ngtcp2_mem_free(strm->mem, strm->tx.streamfrq);
+    }
   }
 
   if (strm->rx.rob) {
-    ngtcp2_rob_free(strm->rx.rob);
-    ngtcp2_mem_free(strm->mem, strm->rx.rob);
+    if (pool && pool->nrob < NGTCP2_STRM_POOL_MAX) {
+      ngtcp2_rob_clear(strm->rx.rob);
+      pool->rob[pool->nrob++] = strm->rx.rob;
+    } else {
+      ngtcp2_rob_free(strm->rx.rob);
+      ngtcp2_mem_free(strm->mem, strm->rx.rob);
+    }
   }
 
   if (strm->tx.acked_offset) {
-    ngtcp2_gaptr_free(strm->tx.acked_offset);
-    ngtcp2_mem_free(strm->mem, strm->tx.acked_offset);
+    if (pool && pool->nacked_offset < NGTCP2_STRM_POOL_MAX) {
+      ngtcp2_gaptr_clear(strm->tx.acked_offset);
+      pool->acked_offset[pool->nacked_offset++] = strm->tx.acked_offset;
+    } else {
+      ngtcp2_gaptr_free(strm->tx.acked_offset);
+      ngtcp2_mem_free(strm->mem, strm->tx.acked_offset);
+    }
+  }
+
+  for (buf = strm->tx.bufs; buf;) {
+    next = buf->next;
+    ngtcp2_strm_buf_del(buf, strm->mem);
+    buf = next;
+  }
+
+  if (strm->tx.sendbuf) {
+    strm_sendbuf_free(strm->tx.sendbuf, strm->mem);
+  }
+
+  ngtcp2_mem_free(strm->mem, strm->tx.fec);
+
+  if (strm->rx.fec) {
+    ngtcp2_fec_rxbuf_del(strm->rx.fec, strm->mem);
   }
 }
 
+/* strm_rob_chunk returns the chunk size of ngtcp2_rob for |strm|.  A
+   small flow control window cannot fill a large chunk, so the chunk
+   is scaled down with the window. */
+static size_t strm_rob_chunk(ngtcp2_strm *strm) {
+  size_t chunk = NGTCP2_STRM_ROB_MAX_CHUNK;
+
+  for (; chunk > NGTCP2_STRM_ROB_MIN_CHUNK &&
+         (uint64_t)chunk * NGTCP2_STRM_ROB_CHUNKS_PER_WINDOW > strm->rx.window;
+       chunk /= 2)
+    ;
+
+  return chunk;
+}
+
 static int strm_rob_init(ngtcp2_strm *strm) {
   int rv;
-  ngtcp2_rob *rob = ngtcp2_mem_malloc(strm->mem, sizeof(*rob));
+  ngtcp2_rob *rob;
+
+  if (strm->pool && strm->pool->nrob) {
+    rob = strm->pool->rob[strm->pool->nrob - 1];
+
+    rv = ngtcp2_rob_reinit(rob, strm_rob_chunk(strm));
+    if (rv != 0) {
+      return rv;
+    }
+
+    --strm->pool->nrob;
+    strm->rx.rob = rob;
 
+    return 0;
+  }
+
+  rob = ngtcp2_mem_malloc(strm->mem, sizeof(*rob));
   if (rob == NULL) {
     return NGTCP2_ERR_NOMEM;
   }
 
-  rv = ngtcp2_rob_init(rob, 8 * 1024, strm->mem);
+  rv = ngtcp2_rob_init(rob, strm_rob_chunk(strm), strm->mem);
   if (rv != 0) {
     ngtcp2_mem_free(strm->mem, rob);
     return rv;
@@ -117,6 +236,19 @@ uint64_t ngtcp2_strm_rx_offset(ngtcp2_strm *strm) {
   return ngtcp2_rob_first_gap_offset(strm->rx.rob);
 }
 
+int ngtcp2_strm_rx_data_received(ngtcp2_strm *strm, uint64_t offset,
+                                 uint64_t len) {
+  if (offset + len <= ngtcp2_strm_rx_offset(strm)) {
+    return 1;
+  }
+
+  if (strm->rx.rob == NULL) {
+    return 0;
+  }
+
+  return ngtcp2_rob_is_received(strm->rx.rob, offset, len);
+}
+
 /* strm_rob_heavily_fragmented returns nonzero if the number of gaps
    in |rob| exceeds the limit. */
 static int strm_rob_heavily_fragmented(ngtcp2_rob *rob) {
@@ -162,19 +294,104 @@ void ngtcp2_strm_shutdown(ngtcp2_strm *strm, uint32_t flags) {
 }
 
 static int strm_streamfrq_init(ngtcp2_strm *strm) {
-  ngtcp2_ksl *streamfrq = ngtcp2_mem_malloc(strm->mem, sizeof(*streamfrq));
+  ngtcp2_ksl *streamfrq;
+
+  if (strm->pool && strm->pool->nstreamfrq) {
+    strm->tx.streamfrq = strm->pool->streamfrq[--strm->pool->nstreamfrq];
+    return 0;
+  }
+
+  streamfrq = ngtcp2_mem_malloc(strm->mem, sizeof(*streamfrq));
   if (streamfrq == NULL) {
     return NGTCP2_ERR_NOMEM;
   }
 
-  ngtcp2_ksl_init(streamfrq, offset_less, sizeof(uint64_t), strm->mem);
+  ngtcp2_ksl_init(streamfrq, ngtcp2_ksl_int64_less, sizeof(uint64_t),
+                  strm->mem);
 
   strm->tx.streamfrq = streamfrq;
 
   return 0;
 }
 
+/*
+ * strm_stream_skip removes the first |n| bytes from |fr|.
+ */
+static void strm_stream_skip(ngtcp2_stream *fr, uint64_t n) {
+  size_t i;
+
+  fr->offset += n;
+
+  for (i = 0; i < fr->datacnt && n >= fr->data[i].len; ++i) {
+    n -= fr->data[i].len;
+  }
+
+  assert(i < fr->datacnt || n == 0);
+
+  fr->datacnt -= i;
+  memmove(fr->data, fr->data + i, sizeof(fr->data[0]) * fr->datacnt);
+
+  if (n) {
+    fr->data[0].base += n;
+    fr->data[0].len -= (size_t)n;
+  }
+}
+
+/*
+ * strm_streamfrq_push_head moves the first |len| bytes of |frc| into
+ * a newly allocated ngtcp2_frame_chain and inserts it into streamfrq.
+ * |frc| is left with the remaining data.
+ */
+static int strm_streamfrq_push_head(ngtcp2_strm *strm,
+                                    ngtcp2_frame_chain *frc, uint64_t len) {
+  ngtcp2_stream *fr = &frc->fr.stream, *nfr;
+  ngtcp2_frame_chain *nfrc;
+  ngtcp2_vec a[NGTCP2_MAX_STREAM_DATACNT];
+  ngtcp2_vec b[NGTCP2_MAX_STREAM_DATACNT];
+  size_t acnt, bcnt;
+  int rv;
+
+  ngtcp2_vec_copy(a, fr->data, fr->datacnt);
+  acnt = fr->datacnt;
+
+  bcnt = 0;
+  ngtcp2_vec_split(a, &acnt, b, &bcnt, (size_t)len,
+                   NGTCP2_MAX_STREAM_DATACNT);
+
+  assert(acnt > 0);
+  assert(bcnt > 0);
+
+  rv = ngtcp2_frame_chain_stream_datacnt_objalloc_new(
+      &nfrc, acnt, strm->frc_objalloc, strm->mem);
+  if (rv != 0) {
+    return rv;
+  }
+
+  nfr = &nfrc->fr.stream;
+  nfr->type = NGTCP2_FRAME_STREAM;
+  nfr->flags = 0;
+  nfr->fin = 0;
+  nfr->stream_id = fr->stream_id;
+  nfr->offset = fr->offset;
+  nfr->datacnt = acnt;
+  ngtcp2_vec_copy(nfr->data, a, acnt);
+
+  rv = ngtcp2_ksl_insert(strm->tx.streamfrq, NULL, &nfr->offset, nfrc);
+  if (rv != 0) {
+    assert(ngtcp2_err_is_fatal(rv));
+    ngtcp2_frame_chain_objalloc_del(nfrc, strm->frc_objalloc, strm->mem);
+    return rv;
+  }
+
+  strm_stream_skip(fr, len);
+
+  return 0;
+}
+
 int ngtcp2_strm_streamfrq_push(ngtcp2_strm *strm, ngtcp2_frame_chain *frc) {
+  ngtcp2_stream *fr = &frc->fr.stream, *qfr;
+  ngtcp2_ksl_it it;
+  uint64_t end, qend;
   int rv;
 
   assert(frc->fr.type == NGTCP2_FRAME_STREAM);
@@ -187,8 +404,88 @@ int ngtcp2_strm_streamfrq_push(ngtcp2_strm *strm, ngtcp2_frame_chain *frc) {
     }
   }
 
-  return ngtcp2_ksl_insert(strm->tx.streamfrq, NULL, &frc->fr.stream.offset,
-                           frc);
+  /* Keep the ranges in streamfrq disjoint so that the same data is
+     never retransmitted twice when overlapping STREAM frames are
+     declared lost. */
+  end = fr->offset + ngtcp2_vec_len(fr->data, fr->datacnt);
+
+  it = ngtcp2_ksl_lower_bound(strm->tx.streamfrq, &fr->offset);
+  if (!ngtcp2_ksl_it_begin(&it)) {
+    ngtcp2_ksl_it_prev(&it);
+    qfr = &((ngtcp2_frame_chain *)ngtcp2_ksl_it_get(&it))->fr.stream;
+    qend = qfr->offset + ngtcp2_vec_len(qfr->data, qfr->datacnt);
+
+    if (qend > fr->offset) {
+      strm_stream_skip(fr, ngtcp2_min(qend, end) - fr->offset);
+    }
+  }
+
+  for (;;) {
+    it = ngtcp2_ksl_lower_bound(strm->tx.streamfrq, &fr->offset);
+    if (ngtcp2_ksl_it_end(&it)) {
+      break;
+    }
+
+    qfr = &((ngtcp2_frame_chain *)ngtcp2_ksl_it_get(&it))->fr.stream;
+    if (qfr->offset >= end) {
+      break;
+    }
+
+    if (qfr->offset > fr->offset) {
+      rv = strm_streamfrq_push_head(strm, frc, qfr->offset - fr->offset);
+      if (rv != 0) {
+        return rv;
+      }
+    }
+
+    qend = qfr->offset + ngtcp2_vec_len(qfr->data, qfr->datacnt);
+
+    strm_stream_skip(fr, ngtcp2_min(qend, end) - fr->offset);
+  }
+
+  if (fr->offset == end && (fr->offset || fr->datacnt)) {
+    /* All data is already in streamfrq.  Only fin may still need to
+       be sent. */
+    if (!fr->fin) {
+      ngtcp2_frame_chain_objalloc_del(frc, strm->frc_objalloc, strm->mem);
+      return 0;
+    }
+
+    fr->datacnt = 0;
+
+    it = ngtcp2_ksl_lower_bound(strm->tx.streamfrq, &fr->offset);
+    if (!ngtcp2_ksl_it_end(&it) &&
+        *(uint64_t *)ngtcp2_ksl_it_key(&it) == fr->offset) {
+      qfr = &((ngtcp2_frame_chain *)ngtcp2_ksl_it_get(&it))->fr.stream;
+      qfr->fin = 1;
+      ngtcp2_frame_chain_objalloc_del(frc, strm->frc_objalloc, strm->mem);
+      return 0;
+    }
+
+    if (!ngtcp2_ksl_it_begin(&it)) {
+      ngtcp2_ksl_it_prev(&it);
+      qfr = &((ngtcp2_frame_chain *)ngtcp2_ksl_it_get(&it))->fr.stream;
+      if (qfr->offset + ngtcp2_vec_len(qfr->data, qfr->datacnt) ==
+          fr->offset) {
+        qfr->fin = 1;
+        ngtcp2_frame_chain_objalloc_del(frc, strm->frc_objalloc, strm->mem);
+        return 0;
+      }
+    }
+  } else {
+    it = ngtcp2_ksl_lower_bound(strm->tx.streamfrq, &fr->offset);
+    if (!ngtcp2_ksl_it_end(&it) &&
+        *(uint64_t *)ngtcp2_ksl_it_key(&it) == fr->offset) {
+      /* 0 length STREAM frame at offset 0 which is already
+         queued. */
+      qfr = &((ngtcp2_frame_chain *)ngtcp2_ksl_it_get(&it))->fr.stream;
+      qfr->fin |= fr->fin;
+      ngtcp2_frame_chain_objalloc_del(frc, strm->frc_objalloc, strm->mem);
+      return 0;
+    }
+  }
+
+  return ngtcp2_ksl_insert(strm->tx.streamfrq, NULL, &fr->offset, frc);
 }
 
 static int strm_streamfrq_unacked_pop(ngtcp2_strm *strm,
@@ -358,8 +655,7 @@ int ngtcp2_strm_streamfrq_pop(ngtcp2_strm *strm, ngtcp2_frame_chain **pfrc,
   size_t nmerged;
   uint64_t datalen;
   ngtcp2_vec a[NGTCP2_MAX_STREAM_DATACNT];
-  ngtcp2_vec b[NGTCP2_MAX_STREAM_DATACNT];
-  size_t acnt, bcnt;
+  size_t acnt, idx, offset;
   uint64_t unacked_offset;
 
   if (strm->tx.streamfrq == NULL || ngtcp2_ksl_len(strm->tx.streamfrq) == 0) {
@@ -394,17 +690,13 @@ int ngtcp2_strm_streamfrq_pop(ngtcp2_strm *strm, ngtcp2_frame_chain **pfrc,
   }
 
   if (datalen > left) {
-    ngtcp2_vec_copy(a, fr->data, fr->datacnt);
-    acnt = fr->datacnt;
-
-    bcnt = 0;
-    ngtcp2_vec_split(a, &acnt, b, &bcnt, left, NGTCP2_MAX_STREAM_DATACNT);
-
-    assert(acnt > 0);
-    assert(bcnt > 0);
+    /* The remaining data is copied to a new frame directly from
+       fr->data, and frc is truncated in place to carry the first
+       |left| bytes. */
+    idx = ngtcp2_vec_split_at(fr->data, fr->datacnt, left, &offset);
 
     rv = ngtcp2_frame_chain_stream_datacnt_objalloc_new(
-        &nfrc, bcnt, strm->frc_objalloc, strm->mem);
+        &nfrc, fr->datacnt - idx, strm->frc_objalloc, strm->mem);
     if (rv != 0) {
       assert(ngtcp2_err_is_fatal(rv));
       ngtcp2_frame_chain_objalloc_del(frc, strm->frc_objalloc, strm->mem);
@@ -417,8 +709,10 @@ int ngtcp2_strm_streamfrq_pop(ngtcp2_strm *strm, ngtcp2_frame_chain **pfrc,
     nfr->fin = fr->fin;
     nfr->stream_id = fr->stream_id;
     nfr->offset = fr->offset + left;
-    nfr->datacnt = bcnt;
-    ngtcp2_vec_copy(nfr->data, b, bcnt);
+    nfr->datacnt = fr->datacnt - idx;
+    ngtcp2_vec_copy(nfr->data, fr->data + idx, nfr->datacnt);
+    nfr->data[0].base += offset;
+    nfr->data[0].len -= offset;
 
     rv = ngtcp2_ksl_insert(strm->tx.streamfrq, NULL, &nfr->offset, nfrc);
     if (rv != 0) {
@@ -428,31 +722,24 @@ int ngtcp2_strm_streamfrq_pop(ngtcp2_strm *strm, ngtcp2_frame_chain **pfrc,
       return rv;
     }
 
-    rv = ngtcp2_frame_chain_stream_datacnt_objalloc_new(
-        &nfrc, acnt, strm->frc_objalloc, strm->mem);
-    if (rv != 0) {
-      assert(ngtcp2_err_is_fatal(rv));
-      ngtcp2_frame_chain_objalloc_del(frc, strm->frc_objalloc, strm->mem);
-      return rv;
+    fr->fin = 0;
+    fr->datacnt = idx;
+    if (offset) {
+      fr->data[fr->datacnt++].len = offset;
     }
 
-    nfr = &nfrc->fr.stream;
-    *nfr = *fr;
-    nfr->fin = 0;
-    nfr->datacnt = acnt;
-    ngtcp2_vec_copy(nfr->data, a, acnt);
+    assert(fr->datacnt > 0);
 
-    ngtcp2_frame_chain_objalloc_del(frc, strm->frc_objalloc, strm->mem);
-
-    *pfrc = nfrc;
+    *pfrc = frc;
 
     return 0;
   }
 
   left -= (size_t)datalen;
 
-  ngtcp2_vec_copy(a, fr->data, fr->datacnt);
-  acnt = fr->datacnt;
+  /* a is filled lazily when the first frame is merged.  acnt == 0
+     means that a has not been filled yet unless fr has no data. */
+  acnt = 0;
 
   for (; left && ngtcp2_ksl_len(strm->tx.streamfrq);) {
     unacked_offset = ngtcp2_strm_streamfrq_unacked_offset(strm);
@@ -479,6 +766,11 @@ int ngtcp2_strm_streamfrq_pop(ngtcp2_strm *strm, ngtcp2_frame_chain **pfrc,
       break;
     }
 
+    if (acnt == 0) {
+      ngtcp2_vec_copy(a, fr->data, fr->datacnt);
+      acnt = fr->datacnt;
+    }
+
     nmerged = ngtcp2_vec_merge(a, &acnt, nfr->data, &nfr->datacnt, left,
                                NGTCP2_MAX_STREAM_DATACNT);
     if (nmerged == 0) {
@@ -513,10 +805,13 @@ int ngtcp2_strm_streamfrq_pop(ngtcp2_strm *strm, ngtcp2_frame_chain **pfrc,
     break;
   }
 
+  if (acnt == 0) {
+    *pfrc = frc;
+    return 0;
+  }
+
   if (acnt == fr->datacnt) {
-    if (acnt > 0) {
-      fr->data[acnt - 1] = a[acnt - 1];
-    }
+    fr->data[acnt - 1] = a[acnt - 1];
 
     *pfrc = frc;
     return 0;
@@ -647,9 +942,15 @@ uint64_t ngtcp2_strm_get_acked_offset(ngtcp2_strm *strm) {
 }
 
 static int strm_acked_offset_init(ngtcp2_strm *strm) {
-  ngtcp2_gaptr *acked_offset =
-      ngtcp2_mem_malloc(strm->mem, sizeof(*acked_offset));
+  ngtcp2_gaptr *acked_offset;
 
+  if (strm->pool && strm->pool->nacked_offset) {
+    strm->tx.acked_offset =
+        strm->pool->acked_offset[--strm->pool->nacked_offset];
+    return 0;
+  }
+
+  acked_offset = ngtcp2_mem_malloc(strm->mem, sizeof(*acked_offset));
   if (acked_offset == NULL) {
     return NGTCP2_ERR_NOMEM;
   }
@@ -685,6 +986,205 @@ int ngtcp2_strm_ack_data(ngtcp2_strm *strm, uint64_t offset, uint64_t len) {
   return ngtcp2_gaptr_push(strm->tx.acked_offset, offset, len);
 }
 
+int ngtcp2_strm_attach_buf(ngtcp2_strm *strm, uint64_t datalen,
+                           void *buf_user_data) {
+  ngtcp2_strm_buf *buf = ngtcp2_mem_malloc(strm->mem, sizeof(*buf));
+
+  if (buf == NULL) {
+    return NGTCP2_ERR_NOMEM;
+  }
+
+  buf->next = NULL;
+  buf->range.begin = strm->tx.buf_offset;
+  buf->range.end = strm->tx.buf_offset + datalen;
+  buf->buf_user_data = buf_user_data;
+
+  *strm->tx.bufs_tail = buf;
+  strm->tx.bufs_tail = &buf->next;
+  strm->tx.buf_offset = buf->range.end;
+
+  return 0;
+}
+
+ngtcp2_strm_buf *ngtcp2_strm_detach_acked_bufs(ngtcp2_strm *strm) {
+  ngtcp2_strm_buf *head = NULL, **ptail = &head;
+  ngtcp2_strm_buf **pbuf, *buf;
+  ngtcp2_range gap;
+
+  /* The buffers which are not sent entirely cannot be acknowledged. */
+  for (pbuf = &strm->tx.bufs;
+       *pbuf && (*pbuf)->range.begin < strm->tx.offset;) {
+    buf = *pbuf;
+
+    gap = ngtcp2_strm_get_unacked_range_after(strm, buf->range.begin);
+    if (gap.begin < buf->range.end) {
+      pbuf = &buf->next;
+      continue;
+    }
+
+    *pbuf = buf->next;
+    buf->next = NULL;
+    *ptail = buf;
+    ptail = &buf->next;
+  }
+
+  if (*pbuf == NULL) {
+    strm->tx.bufs_tail = pbuf;
+  }
+
+  return head;
+}
+
+ngtcp2_strm_buf *ngtcp2_strm_detach_bufs(ngtcp2_strm *strm) {
+  ngtcp2_strm_buf *head = strm->tx.bufs;
+
+  strm->tx.bufs = NULL;
+  strm->tx.bufs_tail = &strm->tx.bufs;
+
+  return head;
+}
+
+void ngtcp2_strm_buf_del(ngtcp2_strm_buf *buf, const ngtcp2_mem *mem) {
+  ngtcp2_mem_free(mem, buf);
+}
+
+int ngtcp2_strm_sendbuf_init(ngtcp2_strm *strm, size_t maxlen) {
+  ngtcp2_strm_sendbuf *sendbuf;
+
+  assert(strm->tx.sendbuf == NULL);
+
+  sendbuf = ngtcp2_mem_malloc(strm->mem, sizeof(*sendbuf));
+  if (sendbuf == NULL) {
+    return NGTCP2_ERR_NOMEM;
+  }
+
+  sendbuf->head = sendbuf->tail = sendbuf->spare = NULL;
+  sendbuf->offset = sendbuf->end = strm->tx.offset;
+  sendbuf->maxlen = maxlen;
+  sendbuf->chunklen = ngtcp2_min(maxlen, NGTCP2_STRM_SENDBUF_CHUNKLEN);
+  sendbuf->fin = 0;
+
+  strm->tx.sendbuf = sendbuf;
+
+  return 0;
+}
+
+static uint8_t *strm_sendbuf_chunk_data(ngtcp2_strm_sendbuf_chunk *chunk) {
+  return (uint8_t *)chunk + sizeof(*chunk);
+}
+
+ngtcp2_ssize ngtcp2_strm_sendbuf_write(ngtcp2_strm *strm, const uint8_t *data,
+                                       size_t datalen, int fin) {
+  ngtcp2_strm_sendbuf *sendbuf = strm->tx.sendbuf;
+  ngtcp2_strm_sendbuf_chunk *chunk;
+  size_t left = sendbuf->maxlen - (size_t)(sendbuf->end - sendbuf->offset);
+  size_t nwrite = ngtcp2_min(datalen, left), n;
+  const uint8_t *p = data, *end = data + nwrite;
+
+  assert(!sendbuf->fin);
+
+  for (; p != end;) {
+    chunk = sendbuf->tail;
+
+    if (chunk == NULL || chunk->len == sendbuf->chunklen) {
+      if (sendbuf->spare) {
+        chunk = sendbuf->spare;
+        sendbuf->spare = NULL;
+      } else {
+        chunk = ngtcp2_mem_malloc(strm->mem,
+                                  sizeof(*chunk) + sendbuf->chunklen);
+        if (chunk == NULL) {
+          if (p == data) {
+            return NGTCP2_ERR_NOMEM;
+          }
+
+          break;
+        }
+      }
+
+      chunk->next = NULL;
+      chunk->offset = sendbuf->end;
+      chunk->len = 0;
+
+      if (sendbuf->tail) {
+        sendbuf->tail->next = chunk;
+      } else {
+        sendbuf->head = chunk;
+      }
+
+      sendbuf->tail = chunk;
+    }
+
+    n = ngtcp2_min((size_t)(end - p), sendbuf->chunklen - chunk->len);
+    memcpy(strm_sendbuf_chunk_data(chunk) + chunk->len, p, n);
+    chunk->len += n;
+    sendbuf->end += n;
+    p += n;
+  }
+
+  if (fin && (size_t)(p - data) == datalen) {
+    sendbuf->fin = 1;
+  }
+
+  return p - data;
+}
+
+size_t ngtcp2_strm_sendbuf_get_unsent(ngtcp2_strm *strm, ngtcp2_vec *vec,
+                                      size_t veccnt, uint64_t *pdatalen) {
+  ngtcp2_strm_sendbuf *sendbuf = strm->tx.sendbuf;
+  ngtcp2_strm_sendbuf_chunk *chunk;
+  uint64_t offset = strm->tx.offset, datalen = 0;
+  size_t n = 0, skip;
+
+  for (chunk = sendbuf->head; chunk && n < veccnt; chunk = chunk->next) {
+    if (chunk->offset + chunk->len <= offset) {
+      continue;
+    }
+
+    skip = (size_t)(offset - chunk->offset);
+
+    vec[n].base = strm_sendbuf_chunk_data(chunk) + skip;
+    vec[n].len = chunk->len - skip;
+    datalen += vec[n].len;
+    ++n;
+
+    offset = chunk->offset + chunk->len;
+  }
+
+  *pdatalen = datalen;
+
+  return n;
+}
+
+void ngtcp2_strm_sendbuf_release(ngtcp2_strm *strm) {
+  ngtcp2_strm_sendbuf *sendbuf = strm->tx.sendbuf;
+  ngtcp2_strm_sendbuf_chunk *chunk;
+  uint64_t acked_offset = ngtcp2_strm_get_acked_offset(strm);
+
+  for (; sendbuf->head;) {
+    chunk = sendbuf->head;
+
+    /* The chunk which is not filled up may receive more data. */
+    if ((!sendbuf->fin && chunk->len != sendbuf->chunklen) ||
+        chunk->offset + chunk->len > acked_offset) {
+      break;
+    }
+
+    sendbuf->head = chunk->next;
+    if (sendbuf->head == NULL) {
+      sendbuf->tail = NULL;
+    }
+
+    sendbuf->offset += chunk->len;
+
+    if (sendbuf->spare == NULL) {
+      sendbuf->spare = chunk;
+    } else {
+      ngtcp2_mem_free(strm->mem, chunk);
+    }
+  }
+}
+
 void ngtcp2_strm_set_app_error_code(ngtcp2_strm *strm,
                                     uint64_t app_error_code) {
   if (strm->flags & NGTCP2_STRM_FLAG_APP_ERROR_CODE_SET) {
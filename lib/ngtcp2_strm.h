@@ -36,9 +36,85 @@
 #include "ngtcp2_gaptr.h"
 #include "ngtcp2_ksl.h"
 #include "ngtcp2_pq.h"
+#include "ngtcp2_fec.h"
 
 typedef struct ngtcp2_frame_chain ngtcp2_frame_chain;
 
+/*
+ * ngtcp2_strm_buf is the range of outgoing stream data which is
+ * backed by the application buffer identified by buf_user_data.
+ */
+typedef struct ngtcp2_strm_buf ngtcp2_strm_buf;
+
+struct ngtcp2_strm_buf {
+  ngtcp2_strm_buf *next;
+  ngtcp2_range range;
+  void *buf_user_data;
+};
+
+/* NGTCP2_STRM_SENDBUF_CHUNKLEN is the maximum length of a chunk of
+   ngtcp2_strm_sendbuf. */
+#define NGTCP2_STRM_SENDBUF_CHUNKLEN (16 * 1024)
+/* NGTCP2_STRM_SENDBUF_MAX_VECCNT is the maximum number of ngtcp2_vec
+   that ngtcp2_strm_sendbuf_get_unsent assigns. */
+#define NGTCP2_STRM_SENDBUF_MAX_VECCNT 8
+
+/*
+ * ngtcp2_strm_sendbuf_chunk is a fixed size chunk of
+ * ngtcp2_strm_sendbuf.  The data follow this struct in the same
+ * allocation.
+ */
+typedef struct ngtcp2_strm_sendbuf_chunk ngtcp2_strm_sendbuf_chunk;
+
+struct ngtcp2_strm_sendbuf_chunk {
+  ngtcp2_strm_sendbuf_chunk *next;
+  /* offset is the stream offset of the first byte of this chunk. */
+  uint64_t offset;
+  /* len is the number of bytes written to this chunk. */
+  size_t len;
+};
+
+/*
+ * ngtcp2_strm_sendbuf is the library owned buffer of outgoing stream
+ * data.  It is a list of chunks ordered by stream offset, and the
+ * chunk is released when all data in it are acknowledged.
+ */
+typedef struct ngtcp2_strm_sendbuf {
+  /* head is the chunk which contains the oldest unacknowledged
+     data. */
+  ngtcp2_strm_sendbuf_chunk *head;
+  /* tail is the chunk to which data are appended. */
+  ngtcp2_strm_sendbuf_chunk *tail;
+  /* spare is a released chunk which is kept to be reused. */
+  ngtcp2_strm_sendbuf_chunk *spare;
+  /* offset is the stream offset of the first byte in head. */
+  uint64_t offset;
+  /* end is the stream offset of the next byte to be appended. */
+  uint64_t end;
+  /* maxlen is the maximum number of bytes that this buffer holds. */
+  size_t maxlen;
+  /* chunklen is the capacity of each chunk. */
+  size_t chunklen;
+  /* fin is nonzero if the last byte of the stream has been
+     appended. */
+  int fin;
+} ngtcp2_strm_sendbuf;
+
+/* NGTCP2_STRM_ROB_MAX_CHUNK is the maximum chunk size of the reorder
+   buffer. */
+#ifndef LOWMEMORY
+#  define NGTCP2_STRM_ROB_MAX_CHUNK (8 * 1024)
+#else /* LOWMEMORY */
+#  define NGTCP2_STRM_ROB_MAX_CHUNK NGTCP2_STRM_ROB_MIN_CHUNK
+#endif /* LOWMEMORY */
+/* NGTCP2_STRM_ROB_MIN_CHUNK is the minimum chunk size of the reorder
+   buffer. */
+#define NGTCP2_STRM_ROB_MIN_CHUNK 1024
+/* NGTCP2_STRM_ROB_CHUNKS_PER_WINDOW is the number of chunks that the
+   receive window must be able to fill for the chunk size to be
+   chosen. */
+#define NGTCP2_STRM_ROB_CHUNKS_PER_WINDOW 16
+
 /* NGTCP2_STRM_FLAG_NONE indicates that no flag is set. */
 #define NGTCP2_STRM_FLAG_NONE 0x00u
 /* NGTCP2_STRM_FLAG_SHUT_RD indicates that further reception of stream
@@ -78,6 +154,43 @@ typedef struct ngtcp2_frame_chain ngtcp2_frame_chain;
 /* NGTCP2_STRM_FLAG_STREAM_STOP_SENDING_CALLED is set when
    stream_stop_sending callback is called. */
 #define NGTCP2_STRM_FLAG_STREAM_STOP_SENDING_CALLED 0x200u
+/* NGTCP2_STRM_FLAG_ACK_BATCHED indicates that the stream is linked
+   to the list of streams that an ACK frame being processed
+   acknowledges. */
+#define NGTCP2_STRM_FLAG_ACK_BATCHED 0x400u
+/* NGTCP2_STRM_FLAG_FIN_ACK_BATCHED indicates that the ACK frame being
+   processed acknowledges a STREAM frame with FIN bit set. */
+#define NGTCP2_STRM_FLAG_FIN_ACK_BATCHED 0x800u
+
+/* NGTCP2_STRM_POOL_MAX is the maximum number of objects of each kind
+   that ngtcp2_strm_pool keeps. */
+#define NGTCP2_STRM_POOL_MAX 16
+
+/*
+ * ngtcp2_strm_pool keeps the sub-objects of the freed streams, which
+ * are emptied but still hold the memory of their internal
+ * structures, so that new streams reuse them without allocation.
+ * They are made usable again when a stream first needs them.
+ */
+typedef struct ngtcp2_strm_pool {
+  ngtcp2_rob *rob[NGTCP2_STRM_POOL_MAX];
+  size_t nrob;
+  ngtcp2_ksl *streamfrq[NGTCP2_STRM_POOL_MAX];
+  size_t nstreamfrq;
+  ngtcp2_gaptr *acked_offset[NGTCP2_STRM_POOL_MAX];
+  size_t nacked_offset;
+} ngtcp2_strm_pool;
+
+/*
+ * ngtcp2_strm_pool_init initializes |pool|.
+ */
+void ngtcp2_strm_pool_init(ngtcp2_strm_pool *pool);
+
+/*
+ * ngtcp2_strm_pool_free frees the objects in |pool| which are
+ * allocated by |mem|.
+ */
+void ngtcp2_strm_pool_free(ngtcp2_strm_pool *pool, const ngtcp2_mem *mem);
 
 typedef struct ngtcp2_strm ngtcp2_strm;
 
@@ -88,6 +201,25 @@ struct ngtcp2_strm {
       uint64_t cycle;
       ngtcp2_objalloc *frc_objalloc;
 
+      /* sched is the state of this stream in ngtcp2_sched which
+         decides the order in which streams send new data. */
+      struct {
+        ngtcp2_pq_entry pe;
+        /* vtime is the virtual time of this stream.  A stream of the
+           smaller vtime is scheduled first. */
+        uint64_t vtime;
+        /* weight is the weight of this stream which is used by
+           NGTCP2_SCHED_POLICY_WEIGHTED_FAIR. */
+        uint16_t weight;
+        /* urgency is the urgency of this stream which is used by
+           NGTCP2_SCHED_POLICY_STRICT_PRIORITY.  The lower value is
+           more urgent. */
+        uint8_t urgency;
+        /* incremental is nonzero if this stream shares the bandwidth
+           with the other streams of the same urgency. */
+        uint8_t incremental;
+      } sched;
+
       struct {
         /* acked_offset tracks acknowledged outgoing data. */
         ngtcp2_gaptr *acked_offset;
@@ -123,6 +255,39 @@ struct ngtcp2_strm {
            is counted to loss_count.  It is used to avoid to count
            multiple STREAM frames in one lost packet. */
         int64_t last_lost_pkt_num;
+        /* acked_next is the next stream in the list of streams that
+           an ACK frame being processed acknowledges.  It is only
+           valid if NGTCP2_STRM_FLAG_ACK_BATCHED is set. */
+        ngtcp2_strm *acked_next;
+        /* acked_prev_offset is the value of
+           ngtcp2_strm_get_acked_offset() before the ACK frame being
+           processed. */
+        uint64_t acked_prev_offset;
+        /* pending_ack_offset and pending_ack_len are the contiguous
+           range of acknowledged data which has not been passed to
+           ngtcp2_strm_ack_data yet. */
+        uint64_t pending_ack_offset;
+        uint64_t pending_ack_len;
+        /* bufs is the list of the application buffers attached by
+           ngtcp2_strm_attach_buf, ordered by stream offset. */
+        ngtcp2_strm_buf *bufs;
+        /* bufs_tail points to the next field of the last buffer in
+           bufs, or bufs if it is empty. */
+        ngtcp2_strm_buf **bufs_tail;
+        /* buf_offset is the stream offset where the next buffer is
+           attached. */
+        uint64_t buf_offset;
+        /* sendbuf, if not NULL, holds the outgoing data on behalf of
+           the application.  See ngtcp2_conn_set_stream_sendbuf. */
+        ngtcp2_strm_sendbuf *sendbuf;
+        /* fec, if not NULL, computes REPAIR frame of the outgoing
+           data.  See ngtcp2_conn_set_stream_fec. */
+        ngtcp2_fec_enc *fec;
+        /* offer_ts is the time when the application first offered
+           the data at offset which have not been sent yet, or
+           UINT64_MAX.  It is only maintained if
+           ngtcp2_settings.latency_stat is nonzero. */
+        ngtcp2_tstamp offer_ts;
       } tx;
 
       struct {
@@ -146,9 +311,26 @@ struct ngtcp2_strm {
         uint64_t unsent_max_offset;
         /* window is the stream-level flow control window size. */
         uint64_t window;
+        /* fec, if not NULL, retains the recently received data to
+           recover a lost STREAM frame from REPAIR frame. */
+        ngtcp2_fec_rxbuf *fec;
+        /* hol_ts is the time when the first data buffered in rob
+           behind a gap was received, or UINT64_MAX.  It is only
+           maintained if ngtcp2_settings.latency_stat is nonzero. */
+        ngtcp2_tstamp hol_ts;
+        /* hol_start is the time when this stream got blocked by a
+           gap, or UINT64_MAX if it is not blocked. */
+        ngtcp2_tstamp hol_start;
+        /* hol is the head-of-line blocking statistics of this
+           stream. */
+        ngtcp2_hol_stat hol;
       } rx;
 
       const ngtcp2_mem *mem;
+      /* pool, if not NULL, is the pool from which the sub-objects of
+         this stream are taken, and to which they are returned by
+         ngtcp2_strm_free. */
+      ngtcp2_strm_pool *pool;
       int64_t stream_id;
       void *stream_user_data;
       /* flags is bit-wise OR of zero or more of NGTCP2_STRM_FLAG_*. */
@@ -197,6 +379,13 @@ uint64_t ngtcp2_strm_rx_offset(ngtcp2_strm *strm);
 int ngtcp2_strm_recv_reordering(ngtcp2_strm *strm, const uint8_t *data,
                                 size_t datalen, uint64_t offset);
 
+/*
+ * ngtcp2_strm_rx_data_received returns nonzero if all incoming data
+ * in the range [|offset|, |offset| + |len|) have been received.
+ */
+int ngtcp2_strm_rx_data_received(ngtcp2_strm *strm, uint64_t offset,
+                                 uint64_t len);
+
 /*
  * ngtcp2_strm_update_rx_offset tells that data up to offset bytes are
  * received in order.
@@ -214,7 +403,12 @@ void ngtcp2_strm_shutdown(ngtcp2_strm *strm, uint32_t flags);
 
 /*
  * ngtcp2_strm_streamfrq_push pushes |frc| to streamfrq for
- * retransmission.
+ * retransmission.  The data in |frc| which overlaps with the data
+ * already in streamfrq is removed from |frc|, and |frc| might be
+ * split into several ngtcp2_frame_chain objects, so that streamfrq
+ * never contains the same range of data twice.  If no data in |frc|
+ * remains to be sent, |frc| is freed.  On error, the ownership of
+ * |frc| is not transferred to |strm|.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -300,6 +494,83 @@ uint64_t ngtcp2_strm_get_acked_offset(ngtcp2_strm *strm);
  */
 int ngtcp2_strm_ack_data(ngtcp2_strm *strm, uint64_t offset, uint64_t len);
 
+/*
+ * ngtcp2_strm_attach_buf attaches the application buffer identified
+ * by |buf_user_data| to the next |datalen| bytes of outgoing data
+ * which no buffer is attached to yet.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory
+ */
+int ngtcp2_strm_attach_buf(ngtcp2_strm *strm, uint64_t datalen,
+                           void *buf_user_data);
+
+/*
+ * ngtcp2_strm_detach_acked_bufs removes the buffers whose data are
+ * all acknowledged from |strm|, and returns them as a list linked by
+ * next field.  The caller must free them by ngtcp2_strm_buf_del.
+ */
+ngtcp2_strm_buf *ngtcp2_strm_detach_acked_bufs(ngtcp2_strm *strm);
+
+/*
+ * ngtcp2_strm_detach_bufs removes all buffers from |strm|, and
+ * returns them as a list linked by next field.  The caller must free
+ * them by ngtcp2_strm_buf_del.
+ */
+ngtcp2_strm_buf *ngtcp2_strm_detach_bufs(ngtcp2_strm *strm);
+
+/*
+ * ngtcp2_strm_buf_del frees |buf|.
+ */
+void ngtcp2_strm_buf_del(ngtcp2_strm_buf *buf, const ngtcp2_mem *mem);
+
+/*
+ * ngtcp2_strm_sendbuf_init makes |strm| own the outgoing data which
+ * are not sent yet, buffering at most |maxlen| bytes.  The buffered
+ * data start at the current stream offset.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory
+ */
+int ngtcp2_strm_sendbuf_init(ngtcp2_strm *strm, size_t maxlen);
+
+/*
+ * ngtcp2_strm_sendbuf_write copies at most |datalen| bytes of |data|
+ * to the send buffer of |strm|, and returns the number of bytes
+ * copied, which is limited by the space left in the buffer.  If |fin|
+ * is nonzero and all data are copied, the last byte becomes the final
+ * byte of the stream.
+ *
+ * This function returns the number of bytes copied if it succeeds,
+ * or one of the following negative error codes:
+ *
+ * NGTCP2_ERR_NOMEM
+ *     Out of memory
+ */
+ngtcp2_ssize ngtcp2_strm_sendbuf_write(ngtcp2_strm *strm, const uint8_t *data,
+                                       size_t datalen, int fin);
+
+/*
+ * ngtcp2_strm_sendbuf_get_unsent assigns the buffered data of |strm|
+ * which are not sent yet to |vec| of length |veccnt|, and returns the
+ * number of elements assigned.  |*pdatalen| is the length of the
+ * assigned data.
+ */
+size_t ngtcp2_strm_sendbuf_get_unsent(ngtcp2_strm *strm, ngtcp2_vec *vec,
+                                      size_t veccnt, uint64_t *pdatalen);
+
+/*
+ * ngtcp2_strm_sendbuf_release releases the chunks of the send buffer
+ * of |strm| whose data are all acknowledged.
+ */
+void ngtcp2_strm_sendbuf_release(ngtcp2_strm *strm);
+
 /*
  * ngtcp2_strm_set_app_error_code sets |app_error_code| to |strm| and
  * set NGTCP2_STRM_FLAG_APP_ERROR_CODE_SET flag.  If the flag is
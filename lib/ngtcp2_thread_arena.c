@@ -0,0 +1,270 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_thread_arena.h"
+
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "ngtcp2_mem.h"
+#include "ngtcp2_macro.h"
+
+/* ngtcp2_thread_arena_hd is the header which precedes each object.
+   Its size keeps the alignment that the underlying allocator
+   guarantees. */
+typedef struct ngtcp2_thread_arena_hd {
+  /* size is the number of bytes usable by the caller. */
+  uint64_t size;
+  /* cls is the size class of the object, or
+     NGTCP2_THREAD_ARENA_NCLASS if the object is allocated from the
+     underlying allocator. */
+  uint64_t cls;
+} ngtcp2_thread_arena_hd;
+
+/* size_classes is the size of an object in each size class,
+   including ngtcp2_thread_arena_hd.  Each size is a multiple of 16
+   so that all objects in a block are aligned. */
+static const size_t size_classes[NGTCP2_THREAD_ARENA_NCLASS] = {
+    32,   48,   64,   96,   128,  192,  256,  384,  512,  768,
+    1024, 1536, 2048, 3072, 4096, 5120, 6144, 7168, 8192, 12288,
+};
+
+/*
+ * size_class returns the smallest size class which holds |n| bytes
+ * including ngtcp2_thread_arena_hd, or NGTCP2_THREAD_ARENA_NCLASS if
+ * there is none.
+ */
+static size_t size_class(size_t n) {
+  size_t lo = 0, hi = NGTCP2_THREAD_ARENA_NCLASS, mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (size_classes[mid] < n) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+/*
+ * arena_alloc_obj returns an object of size class |cls| from the free
+ * list, or carves it out of the current block.  It returns NULL if it
+ * cannot allocate a new block.
+ */
+static void *arena_alloc_obj(ngtcp2_thread_arena *arena, size_t cls) {
+  ngtcp2_thread_arena_free_obj *obj = arena->free_list[cls];
+  ngtcp2_thread_arena_blk *blk;
+  size_t objlen = size_classes[cls];
+  uint8_t *p;
+
+  if (obj) {
+    arena->free_list[cls] = obj->next;
+    return obj;
+  }
+
+  if ((size_t)(arena->end - arena->pos) < objlen) {
+    blk = ngtcp2_mem_malloc(arena->underlying, NGTCP2_THREAD_ARENA_BLKLEN);
+    if (blk == NULL) {
+      return NULL;
+    }
+
+    blk->next = arena->head;
+    arena->head = blk;
+    arena->pos = (uint8_t *)(blk + 1);
+    arena->end = (uint8_t *)blk + NGTCP2_THREAD_ARENA_BLKLEN;
+  }
+
+  p = arena->pos;
+  arena->pos += objlen;
+
+  return p;
+}
+
+static void *arena_malloc(size_t size, void *user_data) {
+  ngtcp2_thread_arena *arena = user_data;
+  ngtcp2_thread_arena_hd *hd;
+  size_t cls;
+
+  if (size > SIZE_MAX - sizeof(*hd)) {
+    return NULL;
+  }
+
+  cls = size_class(sizeof(*hd) + size);
+  if (cls == NGTCP2_THREAD_ARENA_NCLASS) {
+    hd = ngtcp2_mem_malloc(arena->underlying, sizeof(*hd) + size);
+    if (hd == NULL) {
+      return NULL;
+    }
+
+    hd->size = size;
+  } else {
+    hd = arena_alloc_obj(arena, cls);
+    if (hd == NULL) {
+      return NULL;
+    }
+
+    hd->size = size_classes[cls] - sizeof(*hd);
+  }
+
+  hd->cls = cls;
+
+  return hd + 1;
+}
+
+static void arena_free(void *ptr, void *user_data) {
+  ngtcp2_thread_arena *arena = user_data;
+  ngtcp2_thread_arena_hd *hd;
+  ngtcp2_thread_arena_free_obj *obj;
+  size_t cls;
+
+  if (ptr == NULL) {
+    return;
+  }
+
+  hd = (ngtcp2_thread_arena_hd *)ptr - 1;
+  cls = (size_t)hd->cls;
+
+  if (cls == NGTCP2_THREAD_ARENA_NCLASS) {
+    ngtcp2_mem_free(arena->underlying, hd);
+    return;
+  }
+
+  obj = (ngtcp2_thread_arena_free_obj *)(void *)hd;
+  obj->next = arena->free_list[cls];
+  arena->free_list[cls] = obj;
+}
+
+static void *arena_calloc(size_t nmemb, size_t size, void *user_data) {
+  void *p;
+
+  if (size && nmemb > SIZE_MAX / size) {
+    return NULL;
+  }
+
+  p = arena_malloc(nmemb * size, user_data);
+  if (p == NULL) {
+    return NULL;
+  }
+
+  memset(p, 0, nmemb * size);
+
+  return p;
+}
+
+static void *arena_realloc(void *ptr, size_t size, void *user_data) {
+  ngtcp2_thread_arena *arena = user_data;
+  ngtcp2_thread_arena_hd *hd, *nhd;
+  void *p;
+
+  if (ptr == NULL) {
+    return arena_malloc(size, user_data);
+  }
+
+  if (size == 0) {
+    arena_free(ptr, user_data);
+    return NULL;
+  }
+
+  if (size > SIZE_MAX - sizeof(*hd)) {
+    return NULL;
+  }
+
+  hd = (ngtcp2_thread_arena_hd *)ptr - 1;
+
+  if (hd->cls == NGTCP2_THREAD_ARENA_NCLASS) {
+    if (size_class(sizeof(*hd) + size) == NGTCP2_THREAD_ARENA_NCLASS) {
+      nhd = ngtcp2_mem_realloc(arena->underlying, hd, sizeof(*hd) + size);
+      if (nhd == NULL) {
+        return NULL;
+      }
+
+      nhd->size = size;
+
+      return nhd + 1;
+    }
+  } else if (size <= hd->size) {
+    return ptr;
+  }
+
+  p = arena_malloc(size, user_data);
+  if (p == NULL) {
+    return NULL;
+  }
+
+  memcpy(p, ptr, (size_t)ngtcp2_min(hd->size, (uint64_t)size));
+
+  arena_free(ptr, user_data);
+
+  return p;
+}
+
+int ngtcp2_thread_arena_new(ngtcp2_thread_arena **parena,
+                            const ngtcp2_mem *mem) {
+  ngtcp2_thread_arena *arena;
+
+  if (mem == NULL) {
+    mem = ngtcp2_mem_default();
+  }
+
+  arena = ngtcp2_mem_malloc(mem, sizeof(*arena));
+  if (arena == NULL) {
+    return NGTCP2_ERR_NOMEM;
+  }
+
+  memset(arena, 0, sizeof(*arena));
+
+  arena->mem.user_data = arena;
+  arena->mem.malloc = arena_malloc;
+  arena->mem.free = arena_free;
+  arena->mem.calloc = arena_calloc;
+  arena->mem.realloc = arena_realloc;
+  arena->underlying = mem;
+
+  *parena = arena;
+
+  return 0;
+}
+
+void ngtcp2_thread_arena_del(ngtcp2_thread_arena *arena) {
+  ngtcp2_thread_arena_blk *blk, *next;
+
+  if (arena == NULL) {
+    return;
+  }
+
+  for (blk = arena->head; blk; blk = next) {
+    next = blk->next;
+    ngtcp2_mem_free(arena->underlying, blk);
+  }
+
+  ngtcp2_mem_free(arena->underlying, arena);
+}
+
+const ngtcp2_mem *ngtcp2_thread_arena_get_mem(ngtcp2_thread_arena *arena) {
+  return &arena->mem;
+}
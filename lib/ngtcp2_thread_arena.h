@@ -0,0 +1,80 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGTCP2_THREAD_ARENA_H
+#define NGTCP2_THREAD_ARENA_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <ngtcp2/ngtcp2.h>
+
+/* NGTCP2_THREAD_ARENA_NCLASS is the number of size classes. */
+#define NGTCP2_THREAD_ARENA_NCLASS 20
+
+/* NGTCP2_THREAD_ARENA_BLKLEN is the size of a block which
+   ngtcp2_thread_arena obtains from the underlying allocator. */
+#define NGTCP2_THREAD_ARENA_BLKLEN 65536
+
+/* ngtcp2_thread_arena_blk is the header of a block. */
+typedef struct ngtcp2_thread_arena_blk ngtcp2_thread_arena_blk;
+
+struct ngtcp2_thread_arena_blk {
+  ngtcp2_thread_arena_blk *next;
+  /* pad keeps the alignment of the memory which follows the
+     header. */
+  uint64_t pad;
+};
+
+/* ngtcp2_thread_arena_free_obj is a freed object kept in the free
+   list of its size class. */
+typedef struct ngtcp2_thread_arena_free_obj ngtcp2_thread_arena_free_obj;
+
+struct ngtcp2_thread_arena_free_obj {
+  ngtcp2_thread_arena_free_obj *next;
+};
+
+/*
+ * ngtcp2_thread_arena is a per-thread memory allocator which serves
+ * the allocations up to the largest size class from the blocks of
+ * NGTCP2_THREAD_ARENA_BLKLEN bytes.  The freed objects are kept in
+ * the free list of their size class, and the blocks are only returned
+ * to the underlying allocator when the arena is freed.  Nothing is
+ * synchronized: the arena must only be used by the thread which owns
+ * it.
+ */
+struct ngtcp2_thread_arena {
+  ngtcp2_mem mem;
+  /* underlying is the allocator which the blocks and the large
+     objects are allocated from. */
+  const ngtcp2_mem *underlying;
+  /* head is the singly linked list of the blocks. */
+  ngtcp2_thread_arena_blk *head;
+  /* pos and end are the unused region of the current block. */
+  uint8_t *pos, *end;
+  ngtcp2_thread_arena_free_obj *free_list[NGTCP2_THREAD_ARENA_NCLASS];
+};
+
+#endif /* NGTCP2_THREAD_ARENA_H */
@@ -61,6 +61,7 @@ void ngtcp2_vec_del(ngtcp2_vec *vec, const ngtcp2_mem *mem) {
   ngtcp2_mem_free(mem, vec);
 }
 
+#ifdef NOINLINEHELPERS
 uint64_t ngtcp2_vec_len(const ngtcp2_vec *vec, size_t n) {
   size_t i;
   size_t res = 0;
@@ -71,6 +72,7 @@ uint64_t ngtcp2_vec_len(const ngtcp2_vec *vec, size_t n) {
 
   return res;
 }
+#endif /* NOINLINEHELPERS */
 
 int64_t ngtcp2_vec_len_varint(const ngtcp2_vec *vec, size_t n) {
   uint64_t res = 0;
@@ -142,6 +144,21 @@ ngtcp2_ssize ngtcp2_vec_split(ngtcp2_vec *src, size_t *psrccnt, ngtcp2_vec *dst,
   return 0;
 }
 
+size_t ngtcp2_vec_split_at(const ngtcp2_vec *vec, size_t cnt, size_t left,
+                           size_t *poffset) {
+  size_t i;
+
+  for (i = 0; i < cnt && left >= vec[i].len; ++i) {
+    left -= vec[i].len;
+  }
+
+  assert(i < cnt);
+
+  *poffset = left;
+
+  return i;
+}
+
 size_t ngtcp2_vec_merge(ngtcp2_vec *dst, size_t *pdstcnt, ngtcp2_vec *src,
                         size_t *psrccnt, size_t left, size_t maxcnt) {
   size_t orig_left = left;
@@ -62,10 +62,23 @@ int ngtcp2_vec_new(ngtcp2_vec **pvec, const uint8_t *data, size_t datalen,
  */
 void ngtcp2_vec_del(ngtcp2_vec *vec, const ngtcp2_mem *mem);
 
+#ifndef NOINLINEHELPERS
 /*
  * ngtcp2_vec_len returns the sum of length in |vec| of |n| elements.
  */
+static inline uint64_t ngtcp2_vec_len(const ngtcp2_vec *vec, size_t n) {
+  size_t i;
+  size_t res = 0;
+
+  for (i = 0; i < n; ++i) {
+    res += vec[i].len;
+  }
+
+  return res;
+}
+#else /* NOINLINEHELPERS */
 uint64_t ngtcp2_vec_len(const ngtcp2_vec *vec, size_t n);
+#endif /* NOINLINEHELPERS */
 
 /*
  * ngtcp2_vec_len_varint is similar to ngtcp2_vec_len, but it returns
@@ -88,6 +101,20 @@ int64_t ngtcp2_vec_len_varint(const ngtcp2_vec *vec, size_t n);
 ngtcp2_ssize ngtcp2_vec_split(ngtcp2_vec *src, size_t *psrccnt, ngtcp2_vec *dst,
                               size_t *pdstcnt, size_t left, size_t maxcnt);
 
+/*
+ * ngtcp2_vec_split_at finds the position where the first |left|
+ * bytes of |vec| of |cnt| elements end without copying any element.
+ * The sum of the length in |vec| must be larger than |left|.  This
+ * function returns the index of the element which contains the byte
+ * right after the position, and assigns the number of bytes in that
+ * element before the position to |*poffset|.  The first part is made
+ * of the elements before the index and the first |*poffset| bytes of
+ * the element at the index.  The rest starts |*poffset| bytes into
+ * the element at the index.
+ */
+size_t ngtcp2_vec_split_at(const ngtcp2_vec *vec, size_t cnt, size_t left,
+                           size_t *poffset);
+
 /*
  * ngtcp2_vec_merge merges |src| into |dst| by moving at most |left|
  * bytes from |src|.  The |maxcnt| is the maximum number of elements
@@ -0,0 +1,877 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * ccsim is a deterministic discrete-event simulator which measures
+ * the congestion controllers implemented in ngtcp2.  A client sends
+ * bulk data on a single stream to a server through an emulated
+ * bottleneck link.  The link has a fixed bandwidth and a drop-tail
+ * queue in the client to server direction, and the constant
+ * propagation delay in both directions.  No real cryptography is
+ * performed and no time is spent outside of ngtcp2, so the same
+ * options always produce the same result.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <getopt.h>
+
+#include <ngtcp2/ngtcp2.h>
+
+#include "ngtcp2_conn.h"
+#include "ngtcp2_test_helper.h"
+
+#define SIM_MAX_PKTLEN 1452
+#define SIM_STREAM_WINDOW (64 * 1024 * 1024)
+
+typedef struct sim_config {
+  ngtcp2_duration rtt;
+  /* bandwidth is the bottleneck bandwidth in bits per second. */
+  uint64_t bandwidth;
+  /* loss is the probability that a packet from client to server is
+     dropped regardless of the queue occupancy. */
+  double loss;
+  /* buffer is the capacity of bottleneck queue in bytes. */
+  uint64_t buffer;
+  ngtcp2_duration duration;
+  uint64_t seed;
+  /* cwnd_validation is ngtcp2_settings.cwnd_validation of the
+     endpoints. */
+  int cwnd_validation;
+} sim_config;
+
+typedef struct sim_pkt {
+  /* arrival_ts is the timestamp when the packet reaches the peer. */
+  ngtcp2_tstamp arrival_ts;
+  size_t datalen;
+  uint8_t data[SIM_MAX_PKTLEN];
+} sim_pkt;
+
+/* sim_link is a FIFO of packets in flight to one direction.  Because
+   the link delivers packets in order, arrival_ts never decreases from
+   head to tail. */
+typedef struct sim_link {
+  sim_pkt *pkts;
+  size_t cap;
+  size_t head;
+  size_t len;
+  /* free_ts is the timestamp when the bottleneck finishes sending
+     the last queued packet. */
+  ngtcp2_tstamp free_ts;
+} sim_link;
+
+typedef struct sim_stat {
+  uint64_t bytes_recv;
+  uint64_t pkts_sent;
+  uint64_t pkts_dropped_queue;
+  uint64_t pkts_dropped_random;
+  uint64_t pkts_queued;
+  ngtcp2_duration queue_delay_sum;
+  ngtcp2_duration queue_delay_max;
+} sim_stat;
+
+typedef struct sim_endpoint {
+  ngtcp2_conn *conn;
+  ngtcp2_path_storage path;
+  sim_stat *stat;
+} sim_endpoint;
+
+static uint64_t sim_rand_state;
+
+static uint64_t sim_rand(void) {
+  /* splitmix64 */
+  uint64_t z = (sim_rand_state += 0x9e3779b97f4a7c15llu);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9llu;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebllu;
+  return z ^ (z >> 31);
+}
+
+static double sim_rand_double(void) {
+  return (double)(sim_rand() >> 11) / (double)(1llu << 53);
+}
+
+static void sim_link_init(sim_link *link) { memset(link, 0, sizeof(*link)); }
+
+static void sim_link_free(sim_link *link) { free(link->pkts); }
+
+static sim_pkt *sim_link_push(sim_link *link) {
+  sim_pkt *pkts;
+  size_t i;
+
+  if (link->len == link->cap) {
+    pkts = malloc(sizeof(sim_pkt) * (link->cap ? link->cap * 2 : 1024));
+    if (pkts == NULL) {
+      fprintf(stderr, "ccsim: out of memory\n");
+      exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < link->len; ++i) {
+      pkts[i] = link->pkts[(link->head + i) % link->cap];
+    }
+
+    free(link->pkts);
+    link->pkts = pkts;
+    link->cap = link->cap ? link->cap * 2 : 1024;
+    link->head = 0;
+  }
+
+  return &link->pkts[(link->head + link->len++) % link->cap];
+}
+
+static sim_pkt *sim_link_front(sim_link *link) {
+  if (link->len == 0) {
+    return NULL;
+  }
+
+  return &link->pkts[link->head];
+}
+
+static void sim_link_pop(sim_link *link) {
+  assert(link->len);
+
+  link->head = (link->head + 1) % link->cap;
+  --link->len;
+}
+
+static int null_encrypt(uint8_t *dest, const ngtcp2_crypto_aead *aead,
+                        const ngtcp2_crypto_aead_ctx *aead_ctx,
+                        const uint8_t *plaintext, size_t plaintextlen,
+                        const uint8_t *nonce, size_t noncelen,
+                        const uint8_t *aad, size_t aadlen) {
+  (void)aead;
+  (void)aead_ctx;
+  (void)nonce;
+  (void)noncelen;
+  (void)aad;
+  (void)aadlen;
+
+  if (plaintextlen && plaintext != dest) {
+    memcpy(dest, plaintext, plaintextlen);
+  }
+  memset(dest + plaintextlen, 0, NGTCP2_FAKE_AEAD_OVERHEAD);
+
+  return 0;
+}
+
+static int null_decrypt(uint8_t *dest, const ngtcp2_crypto_aead *aead,
+                        const ngtcp2_crypto_aead_ctx *aead_ctx,
+                        const uint8_t *ciphertext, size_t ciphertextlen,
+                        const uint8_t *nonce, size_t noncelen,
+                        const uint8_t *aad, size_t aadlen) {
+  (void)aead;
+  (void)aead_ctx;
+  (void)nonce;
+  (void)noncelen;
+  (void)aad;
+  (void)aadlen;
+  assert(ciphertextlen >= NGTCP2_FAKE_AEAD_OVERHEAD);
+  memmove(dest, ciphertext, ciphertextlen - NGTCP2_FAKE_AEAD_OVERHEAD);
+  return 0;
+}
+
+static int null_hp_mask(uint8_t *dest, const ngtcp2_crypto_cipher *hp,
+                        const ngtcp2_crypto_cipher_ctx *hp_ctx,
+                        const uint8_t *sample) {
+  (void)hp;
+  (void)hp_ctx;
+  (void)sample;
+  memcpy(dest, NGTCP2_FAKE_HP_MASK, sizeof(NGTCP2_FAKE_HP_MASK) - 1);
+  return 0;
+}
+
+/* The handshake is never performed in the simulation.  The following
+   callbacks only satisfy the requirement of ngtcp2_conn. */
+static int client_initial(ngtcp2_conn *conn, void *user_data) {
+  (void)conn;
+  (void)user_data;
+  return NGTCP2_ERR_CALLBACK_FAILURE;
+}
+
+static int recv_client_initial(ngtcp2_conn *conn, const ngtcp2_cid *dcid,
+                               void *user_data) {
+  (void)conn;
+  (void)dcid;
+  (void)user_data;
+  return NGTCP2_ERR_CALLBACK_FAILURE;
+}
+
+static int recv_crypto_data(ngtcp2_conn *conn,
+                            ngtcp2_crypto_level crypto_level, uint64_t offset,
+                            const uint8_t *data, size_t datalen,
+                            void *user_data) {
+  (void)conn;
+  (void)crypto_level;
+  (void)offset;
+  (void)data;
+  (void)datalen;
+  (void)user_data;
+  return 0;
+}
+
+static int recv_retry(ngtcp2_conn *conn, const ngtcp2_pkt_hd *hd,
+                      void *user_data) {
+  (void)conn;
+  (void)hd;
+  (void)user_data;
+  return NGTCP2_ERR_CALLBACK_FAILURE;
+}
+
+static void genrand(uint8_t *dest, size_t destlen,
+                    const ngtcp2_rand_ctx *rand_ctx) {
+  uint64_t r;
+  size_t n;
+  (void)rand_ctx;
+
+  for (; destlen; dest += n, destlen -= n) {
+    r = sim_rand();
+    n = destlen < sizeof(r) ? destlen : sizeof(r);
+    memcpy(dest, &r, n);
+  }
+}
+
+static int get_new_connection_id(ngtcp2_conn *conn, ngtcp2_cid *cid,
+                                 uint8_t *token, size_t cidlen,
+                                 void *user_data) {
+  (void)conn;
+  (void)user_data;
+
+  genrand(cid->data, cidlen, NULL);
+  cid->datalen = cidlen;
+  genrand(token, NGTCP2_STATELESS_RESET_TOKENLEN, NULL);
+
+  return 0;
+}
+
+static int update_key(ngtcp2_conn *conn, uint8_t *rx_secret,
+                      uint8_t *tx_secret, ngtcp2_crypto_aead_ctx *rx_aead_ctx,
+                      uint8_t *rx_iv, ngtcp2_crypto_aead_ctx *tx_aead_ctx,
+                      uint8_t *tx_iv, const uint8_t *current_rx_secret,
+                      const uint8_t *current_tx_secret, size_t secretlen,
+                      void *user_data) {
+  (void)conn;
+  (void)current_rx_secret;
+  (void)current_tx_secret;
+  (void)user_data;
+
+  memset(rx_secret, 0xff, secretlen);
+  memset(tx_secret, 0xff, secretlen);
+  rx_aead_ctx->native_handle = NULL;
+  memset(rx_iv, 0xff, 16);
+  tx_aead_ctx->native_handle = NULL;
+  memset(tx_iv, 0xff, 16);
+
+  return 0;
+}
+
+static void delete_crypto_aead_ctx(ngtcp2_conn *conn,
+                                   ngtcp2_crypto_aead_ctx *aead_ctx,
+                                   void *user_data) {
+  (void)conn;
+  (void)aead_ctx;
+  (void)user_data;
+}
+
+static void delete_crypto_cipher_ctx(ngtcp2_conn *conn,
+                                     ngtcp2_crypto_cipher_ctx *cipher_ctx,
+                                     void *user_data) {
+  (void)conn;
+  (void)cipher_ctx;
+  (void)user_data;
+}
+
+static int get_path_challenge_data(ngtcp2_conn *conn, uint8_t *data,
+                                   void *user_data) {
+  (void)conn;
+  (void)user_data;
+
+  genrand(data, NGTCP2_PATH_CHALLENGE_DATALEN, NULL);
+
+  return 0;
+}
+
+static int recv_stream_data(ngtcp2_conn *conn, uint32_t flags,
+                            int64_t stream_id, uint64_t offset,
+                            const uint8_t *data, size_t datalen,
+                            void *user_data, void *stream_user_data) {
+  sim_endpoint *ep = user_data;
+  int rv;
+  (void)flags;
+  (void)offset;
+  (void)data;
+  (void)stream_user_data;
+
+  ep->stat->bytes_recv += datalen;
+
+  rv = ngtcp2_conn_extend_max_stream_offset(conn, stream_id, datalen);
+  if (rv != 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  ngtcp2_conn_extend_max_offset(conn, datalen);
+
+  return 0;
+}
+
+static uint8_t null_secret[32];
+static uint8_t null_iv[16];
+static uint8_t null_data[64 * 1024];
+
+static void sim_transport_params(ngtcp2_transport_params *params) {
+  memset(params, 0, sizeof(*params));
+  params->initial_max_stream_data_bidi_local = SIM_STREAM_WINDOW;
+  params->initial_max_stream_data_bidi_remote = SIM_STREAM_WINDOW;
+  params->initial_max_stream_data_uni = SIM_STREAM_WINDOW;
+  params->initial_max_data = SIM_STREAM_WINDOW;
+  params->initial_max_streams_bidi = 1;
+  params->initial_max_streams_uni = 0;
+  params->max_idle_timeout = 0;
+  params->max_udp_payload_size = 65527;
+  params->active_connection_id_limit = 8;
+  params->ack_delay_exponent = NGTCP2_DEFAULT_ACK_DELAY_EXPONENT;
+  params->max_ack_delay = NGTCP2_DEFAULT_MAX_ACK_DELAY;
+}
+
+/*
+ * sim_endpoint_init creates ngtcp2_conn which has already completed
+ * handshake.  The keys, transport parameters, and Connection IDs are
+ * set up in the same way as the unit tests do.
+ */
+static void sim_endpoint_init(sim_endpoint *ep, int server,
+                              ngtcp2_cc_algo cc_algo, const sim_config *config,
+                              sim_stat *stat) {
+  ngtcp2_callbacks cb;
+  ngtcp2_settings settings;
+  ngtcp2_transport_params params, remote_params;
+  ngtcp2_cid dcid, scid;
+  ngtcp2_crypto_ctx crypto_ctx;
+  ngtcp2_crypto_aead_ctx aead_ctx = {0};
+  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
+  ngtcp2_conn *conn;
+  ngtcp2_scid *pscid;
+  ngtcp2_ksl_it it;
+  int rv;
+
+  memset(&cb, 0, sizeof(cb));
+  cb.client_initial = client_initial;
+  cb.recv_client_initial = recv_client_initial;
+  cb.recv_crypto_data = recv_crypto_data;
+  cb.recv_retry = recv_retry;
+  cb.decrypt = null_decrypt;
+  cb.encrypt = null_encrypt;
+  cb.hp_mask = null_hp_mask;
+  cb.rand = genrand;
+  cb.get_new_connection_id = get_new_connection_id;
+  cb.update_key = update_key;
+  cb.delete_crypto_aead_ctx = delete_crypto_aead_ctx;
+  cb.delete_crypto_cipher_ctx = delete_crypto_cipher_ctx;
+  cb.get_path_challenge_data = get_path_challenge_data;
+  cb.recv_stream_data = recv_stream_data;
+
+  ngtcp2_settings_default(&settings);
+  settings.initial_ts = 0;
+  settings.cc_algo = cc_algo;
+  settings.no_pmtud = 1;
+  settings.max_udp_payload_size = SIM_MAX_PKTLEN;
+  settings.no_udp_payload_size_shaping = 1;
+  settings.cwnd_validation = config->cwnd_validation;
+
+  sim_transport_params(&params);
+  sim_transport_params(&remote_params);
+
+  memset(&crypto_ctx, 0, sizeof(crypto_ctx));
+  crypto_ctx.aead.max_overhead = NGTCP2_FAKE_AEAD_OVERHEAD;
+  crypto_ctx.max_encryption = UINT64_MAX;
+  crypto_ctx.max_decryption_failure = UINT64_MAX;
+
+  if (server) {
+    path_init(&ep->path, 2, 443, 1, 4433);
+    scid_init(&scid);
+    dcid_init(&dcid);
+
+    rv = ngtcp2_conn_server_new(&conn, &dcid, &scid, &ep->path.path,
+                                NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
+                                NULL, ep);
+  } else {
+    path_init(&ep->path, 1, 4433, 2, 443);
+    dcid_init(&scid);
+    scid_init(&dcid);
+
+    rv = ngtcp2_conn_client_new(&conn, &dcid, &scid, &ep->path.path,
+                                NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
+                                NULL, ep);
+  }
+
+  if (rv != 0) {
+    fprintf(stderr, "ccsim: could not create ngtcp2_conn: %s\n",
+            ngtcp2_strerror(rv));
+    exit(EXIT_FAILURE);
+  }
+
+  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
+  ngtcp2_conn_install_rx_handshake_key(conn, &aead_ctx, null_iv,
+                                       sizeof(null_iv), &hp_ctx);
+  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
+                                       sizeof(null_iv), &hp_ctx);
+  ngtcp2_conn_install_rx_key(conn, null_secret, sizeof(null_secret), &aead_ctx,
+                             null_iv, sizeof(null_iv), &hp_ctx);
+  ngtcp2_conn_install_tx_key(conn, null_secret, sizeof(null_secret), &aead_ctx,
+                             null_iv, sizeof(null_iv), &hp_ctx);
+
+  conn->state = NGTCP2_CS_POST_HANDSHAKE;
+  conn->flags |= NGTCP2_CONN_FLAG_CONN_ID_NEGOTIATED |
+                 NGTCP2_CONN_FLAG_HANDSHAKE_COMPLETED |
+                 NGTCP2_CONN_FLAG_HANDSHAKE_COMPLETED_HANDLED |
+                 NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED;
+  conn->dcid.current.flags |= NGTCP2_DCID_FLAG_PATH_VALIDATED;
+
+  it = ngtcp2_ksl_begin(&conn->scid.set);
+  pscid = ngtcp2_ksl_it_get(&it);
+  pscid->flags |= NGTCP2_SCID_FLAG_USED;
+  ngtcp2_pq_push(&conn->scid.used, &pscid->pe);
+
+  ngtcp2_transport_params_storage_copy(
+      &conn->remote.transport_params_storage[0], &remote_params, conn->mem);
+  conn->remote.transport_params =
+      &conn->remote.transport_params_storage[0].params;
+  conn->local.bidi.max_streams = remote_params.initial_max_streams_bidi;
+  conn->local.uni.max_streams = remote_params.initial_max_streams_uni;
+  conn->tx.max_offset = remote_params.initial_max_data;
+  conn->negotiated_version = conn->client_chosen_version;
+
+  ep->conn = conn;
+  ep->stat = stat;
+}
+
+/*
+ * sim_send_fwd sends a packet from client to server through the
+ * bottleneck.
+ */
+static void sim_send_fwd(sim_link *link, const sim_config *config,
+                         sim_stat *stat, const uint8_t *data, size_t datalen,
+                         ngtcp2_tstamp ts) {
+  sim_pkt *pkt;
+  ngtcp2_tstamp start_ts = link->free_ts > ts ? link->free_ts : ts;
+  ngtcp2_duration queue_delay = start_ts - ts;
+  uint64_t backlog =
+      (uint64_t)((double)queue_delay * (double)config->bandwidth /
+                 (8.0 * NGTCP2_SECONDS));
+
+  ++stat->pkts_sent;
+
+  if (config->loss > 0 && sim_rand_double() < config->loss) {
+    ++stat->pkts_dropped_random;
+    return;
+  }
+
+  if (backlog + datalen > config->buffer) {
+    ++stat->pkts_dropped_queue;
+    return;
+  }
+
+  link->free_ts = start_ts + (ngtcp2_duration)((double)datalen * 8.0 *
+                                               NGTCP2_SECONDS /
+                                               (double)config->bandwidth);
+
+  ++stat->pkts_queued;
+  stat->queue_delay_sum += queue_delay;
+  if (stat->queue_delay_max < queue_delay) {
+    stat->queue_delay_max = queue_delay;
+  }
+
+  pkt = sim_link_push(link);
+  pkt->arrival_ts = link->free_ts + config->rtt / 2;
+  pkt->datalen = datalen;
+  memcpy(pkt->data, data, datalen);
+}
+
+/*
+ * sim_send_rev sends a packet from server to client.  This direction
+ * is not bandwidth limited.
+ */
+static void sim_send_rev(sim_link *link, const sim_config *config,
+                         const uint8_t *data, size_t datalen,
+                         ngtcp2_tstamp ts) {
+  sim_pkt *pkt = sim_link_push(link);
+
+  pkt->arrival_ts = ts + config->rtt / 2;
+  pkt->datalen = datalen;
+  memcpy(pkt->data, data, datalen);
+}
+
+/*
+ * sim_write writes packets from |ep| as much as congestion
+ * controller and pacer allow.  If |stream_id| is not -1, the stream
+ * is filled with the infinite amount of data.
+ */
+static void sim_write(sim_endpoint *ep, int64_t stream_id, sim_link *link,
+                      const sim_config *config, sim_stat *stat,
+                      ngtcp2_tstamp ts) {
+  uint8_t buf[SIM_MAX_PKTLEN];
+  ngtcp2_vec datav = {null_data, sizeof(null_data)};
+  ngtcp2_ssize nwrite;
+  ngtcp2_ssize ndatalen;
+
+  for (;;) {
+    nwrite = ngtcp2_conn_writev_stream(ep->conn, NULL, NULL, buf, sizeof(buf),
+                                       &ndatalen, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                       stream_id,
+                                       stream_id == -1 ? NULL : &datav,
+                                       stream_id == -1 ? 0 : 1, ts);
+    if (nwrite == NGTCP2_ERR_STREAM_DATA_BLOCKED) {
+      stream_id = -1;
+      continue;
+    }
+    if (nwrite < 0) {
+      fprintf(stderr, "ccsim: ngtcp2_conn_writev_stream: %s\n",
+              ngtcp2_strerror((int)nwrite));
+      exit(EXIT_FAILURE);
+    }
+    if (nwrite == 0) {
+      break;
+    }
+
+    if (ep->conn->server) {
+      sim_send_rev(link, config, buf, (size_t)nwrite, ts);
+    } else {
+      sim_send_fwd(link, config, stat, buf, (size_t)nwrite, ts);
+    }
+  }
+
+  ngtcp2_conn_update_pkt_tx_time(ep->conn, ts);
+}
+
+/*
+ * sim_deliver passes the packets which have arrived by |ts| to |ep|.
+ */
+static void sim_deliver(sim_endpoint *ep, sim_link *link, ngtcp2_tstamp ts) {
+  sim_pkt *pkt;
+  ngtcp2_pkt_info pi = {0};
+  int rv;
+
+  for (; (pkt = sim_link_front(link)) != NULL && pkt->arrival_ts <= ts;
+       sim_link_pop(link)) {
+    rv = ngtcp2_conn_read_pkt(ep->conn, &ep->path.path, &pi, pkt->data,
+                              pkt->datalen, ts);
+    if (rv != 0) {
+      fprintf(stderr, "ccsim: ngtcp2_conn_read_pkt: %s\n",
+              ngtcp2_strerror(rv));
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+/*
+ * sim_expiry returns the next timestamp when |ep| has something to
+ * do.  A pacing timer in the past, which is left when congestion
+ * window is full, is ignored so that the simulation does not spin.
+ */
+static ngtcp2_tstamp sim_expiry(sim_endpoint *ep, ngtcp2_tstamp ts) {
+  ngtcp2_tstamp expiry = ngtcp2_conn_get_expiry(ep->conn);
+
+  return expiry <= ts ? UINT64_MAX : expiry;
+}
+
+static void sim_handle_expiry(sim_endpoint *ep, ngtcp2_tstamp ts) {
+  int rv;
+
+  if (ngtcp2_conn_get_expiry(ep->conn) > ts) {
+    return;
+  }
+
+  rv = ngtcp2_conn_handle_expiry(ep->conn, ts);
+  if (rv != 0) {
+    fprintf(stderr, "ccsim: ngtcp2_conn_handle_expiry: %s\n",
+            ngtcp2_strerror(rv));
+    exit(EXIT_FAILURE);
+  }
+}
+
+static ngtcp2_tstamp tstamp_min(ngtcp2_tstamp a, ngtcp2_tstamp b) {
+  return a < b ? a : b;
+}
+
+static const char *cc_algo_str(ngtcp2_cc_algo cc_algo) {
+  switch (cc_algo) {
+  case NGTCP2_CC_ALGO_RENO:
+    return "reno";
+  case NGTCP2_CC_ALGO_CUBIC:
+    return "cubic";
+  case NGTCP2_CC_ALGO_BBR:
+    return "bbr";
+  case NGTCP2_CC_ALGO_BBR2:
+    return "bbr2";
+  default:
+    return "unknown";
+  }
+}
+
+/*
+ * run simulates |cc_algo| under |config|, and returns the goodput in
+ * Mbps.
+ */
+static double run(ngtcp2_cc_algo cc_algo, const sim_config *config) {
+  sim_endpoint client, server;
+  sim_link fwd, rev;
+  sim_stat stat;
+  ngtcp2_tstamp ts = 0, next_ts;
+  sim_pkt *pkt;
+  int64_t stream_id;
+  ngtcp2_conn_stat cstat;
+  double mbps;
+  int rv;
+
+  memset(&stat, 0, sizeof(stat));
+  sim_rand_state = config->seed;
+
+  sim_endpoint_init(&client, /* server = */ 0, cc_algo, config, &stat);
+  sim_endpoint_init(&server, /* server = */ 1, cc_algo, config, &stat);
+  sim_link_init(&fwd);
+  sim_link_init(&rev);
+
+  rv = ngtcp2_conn_open_bidi_stream(client.conn, &stream_id, NULL);
+  if (rv != 0) {
+    fprintf(stderr, "ccsim: ngtcp2_conn_open_bidi_stream: %s\n",
+            ngtcp2_strerror(rv));
+    exit(EXIT_FAILURE);
+  }
+
+  for (;;) {
+    sim_write(&client, stream_id, &fwd, config, &stat, ts);
+    sim_write(&server, -1, &rev, config, &stat, ts);
+
+    next_ts = tstamp_min(sim_expiry(&client, ts), sim_expiry(&server, ts));
+    if ((pkt = sim_link_front(&fwd)) != NULL) {
+      next_ts = tstamp_min(next_ts, pkt->arrival_ts);
+    }
+    if ((pkt = sim_link_front(&rev)) != NULL) {
+      next_ts = tstamp_min(next_ts, pkt->arrival_ts);
+    }
+
+    if (next_ts >= config->duration) {
+      break;
+    }
+
+    ts = next_ts;
+
+    sim_deliver(&server, &fwd, ts);
+    sim_deliver(&client, &rev, ts);
+    sim_handle_expiry(&client, ts);
+    sim_handle_expiry(&server, ts);
+  }
+
+  ngtcp2_conn_get_conn_stat(client.conn, &cstat);
+
+  mbps = (double)stat.bytes_recv * 8 /
+         ((double)config->duration / NGTCP2_SECONDS) / 1000000;
+
+  printf("%-6s %10.2f %10.2f %10.2f %8" PRIu64 " %8" PRIu64 " %8" PRIu64
+         " %7.3f %10.2f %10" PRIu64 "\n",
+         cc_algo_str(cc_algo), mbps,
+         stat.pkts_queued ? (double)stat.queue_delay_sum /
+                                (double)stat.pkts_queued / NGTCP2_MILLISECONDS
+                          : 0.,
+         (double)stat.queue_delay_max / NGTCP2_MILLISECONDS, stat.pkts_sent,
+         stat.pkts_dropped_queue, stat.pkts_dropped_random,
+         stat.pkts_sent ? (double)(stat.pkts_dropped_queue +
+                                   stat.pkts_dropped_random) *
+                              100 / (double)stat.pkts_sent
+                        : 0.,
+         (double)cstat.smoothed_rtt / NGTCP2_MILLISECONDS, cstat.cwnd);
+
+  if (cstat.bbr2_state != NGTCP2_BBR2_STATE_NONE) {
+    printf("#   bbr2 startup=%.0fms drain=%.0fms probe_bw_down=%.0fms "
+           "probe_bw_cruise=%.0fms probe_bw_refill=%.0fms "
+           "probe_bw_up=%.0fms probe_rtt=%.0fms(x%" PRIu64
+           ") inflight_too_high=%" PRIu64 "\n",
+           (double)cstat.bbr2_state_time[NGTCP2_BBR2_STATE_STARTUP] /
+               NGTCP2_MILLISECONDS,
+           (double)cstat.bbr2_state_time[NGTCP2_BBR2_STATE_DRAIN] /
+               NGTCP2_MILLISECONDS,
+           (double)cstat.bbr2_state_time[NGTCP2_BBR2_STATE_PROBE_BW_DOWN] /
+               NGTCP2_MILLISECONDS,
+           (double)cstat.bbr2_state_time[NGTCP2_BBR2_STATE_PROBE_BW_CRUISE] /
+               NGTCP2_MILLISECONDS,
+           (double)cstat.bbr2_state_time[NGTCP2_BBR2_STATE_PROBE_BW_REFILL] /
+               NGTCP2_MILLISECONDS,
+           (double)cstat.bbr2_state_time[NGTCP2_BBR2_STATE_PROBE_BW_UP] /
+               NGTCP2_MILLISECONDS,
+           (double)cstat.bbr2_state_time[NGTCP2_BBR2_STATE_PROBE_RTT] /
+               NGTCP2_MILLISECONDS,
+           cstat.bbr2_state_count[NGTCP2_BBR2_STATE_PROBE_RTT],
+           cstat.bbr2_inflight_too_high_count);
+  }
+
+  ngtcp2_conn_del(client.conn);
+  ngtcp2_conn_del(server.conn);
+  sim_link_free(&fwd);
+  sim_link_free(&rev);
+
+  return mbps;
+}
+
+static void print_usage(void) {
+  printf("Usage: ccsim [OPTIONS]\n"
+         "Options:\n"
+         "  --cc=<ALGO>       Congestion controller to measure.  ALGO is\n"
+         "                    one of reno, cubic, bbr, bbr2, and all.\n"
+         "                    Default: all\n"
+         "  --rtt=<MS>        Round-trip propagation delay in\n"
+         "                    milliseconds.  Default: 50\n"
+         "  --bandwidth=<MBPS>\n"
+         "                    Bottleneck bandwidth in Mbps.  Default: 100\n"
+         "  --loss=<P>        Probability of random loss in [0, 1].\n"
+         "                    Default: 0\n"
+         "  --buffer=<BDP>    Bottleneck buffer size relative to\n"
+         "                    bandwidth-delay product.  Default: 1\n"
+         "  --duration=<SEC>  Simulated duration in seconds.  Default: 10\n"
+         "  --seed=<N>        Seed for the random number generator.\n"
+         "                    Default: 0\n"
+         "  --cwnd-validation Enable congestion window validation.\n"
+         "  --min-mbps=<MBPS> Exit with failure if the goodput of a\n"
+         "                    congestion controller is less than\n"
+         "                    MBPS.  Default: 0\n"
+         "  --help            Display this help and exit.\n");
+}
+
+int main(int argc, char **argv) {
+  sim_config config;
+  double rtt_ms = 50, bandwidth_mbps = 100, bdp = 1, duration_sec = 10;
+  double min_mbps = 0, mbps;
+  const char *cc = "all";
+  ngtcp2_cc_algo cc_algos[] = {
+      NGTCP2_CC_ALGO_RENO,
+      NGTCP2_CC_ALGO_CUBIC,
+      NGTCP2_CC_ALGO_BBR,
+      NGTCP2_CC_ALGO_BBR2,
+  };
+  size_t i;
+  int matched = 0;
+  int status = EXIT_SUCCESS;
+
+  memset(&config, 0, sizeof(config));
+
+  for (;;) {
+    static struct option long_opts[] = {
+        {"cc", required_argument, NULL, 'c'},
+        {"rtt", required_argument, NULL, 'r'},
+        {"bandwidth", required_argument, NULL, 'b'},
+        {"loss", required_argument, NULL, 'l'},
+        {"buffer", required_argument, NULL, 'q'},
+        {"duration", required_argument, NULL, 'd'},
+        {"seed", required_argument, NULL, 's'},
+        {"cwnd-validation", no_argument, NULL, 'v'},
+        {"min-mbps", required_argument, NULL, 'm'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int optidx = 0;
+    int c = getopt_long(argc, argv, "h", long_opts, &optidx);
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case 'c':
+      cc = optarg;
+      break;
+    case 'r':
+      rtt_ms = strtod(optarg, NULL);
+      break;
+    case 'b':
+      bandwidth_mbps = strtod(optarg, NULL);
+      break;
+    case 'l':
+      config.loss = strtod(optarg, NULL);
+      break;
+    case 'q':
+      bdp = strtod(optarg, NULL);
+      break;
+    case 'd':
+      duration_sec = strtod(optarg, NULL);
+      break;
+    case 's':
+      config.seed = strtoull(optarg, NULL, 10);
+      break;
+    case 'v':
+      config.cwnd_validation = 1;
+      break;
+    case 'm':
+      min_mbps = strtod(optarg, NULL);
+      break;
+    case 'h':
+      print_usage();
+      return EXIT_SUCCESS;
+    default:
+      print_usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (rtt_ms <= 0 || bandwidth_mbps <= 0 || bdp < 0 || duration_sec <= 0 ||
+      config.loss < 0 || config.loss > 1 || min_mbps < 0) {
+    fprintf(stderr, "ccsim: invalid argument\n");
+    return EXIT_FAILURE;
+  }
+
+  config.rtt = (ngtcp2_duration)(rtt_ms * NGTCP2_MILLISECONDS);
+  config.bandwidth = (uint64_t)(bandwidth_mbps * 1000000);
+  config.buffer = (uint64_t)(bdp * (double)config.bandwidth / 8 * rtt_ms /
+                             1000);
+  if (config.buffer < SIM_MAX_PKTLEN) {
+    config.buffer = SIM_MAX_PKTLEN;
+  }
+  config.duration = (ngtcp2_duration)(duration_sec * NGTCP2_SECONDS);
+
+  printf("# rtt=%.1fms bandwidth=%.1fMbps loss=%g buffer=%" PRIu64
+         "bytes duration=%.1fs seed=%" PRIu64 " cwnd_validation=%d\n",
+         rtt_ms, bandwidth_mbps, config.loss, config.buffer, duration_sec,
+         config.seed, config.cwnd_validation);
+  printf("%-6s %10s %10s %10s %8s %8s %8s %7s %10s %10s\n", "cc", "Mbps",
+         "qdelay_ms", "qmax_ms", "sent", "qdrop", "rdrop", "loss%", "srtt_ms",
+         "cwnd");
+
+  for (i = 0; i < sizeof(cc_algos) / sizeof(cc_algos[0]); ++i) {
+    if (strcmp(cc, "all") != 0 && strcmp(cc, cc_algo_str(cc_algos[i])) != 0) {
+      continue;
+    }
+
+    matched = 1;
+    mbps = run(cc_algos[i], &config);
+    if (mbps < min_mbps) {
+      fprintf(stderr, "ccsim: %s: %.2fMbps is less than %.2fMbps\n",
+              cc_algo_str(cc_algos[i]), mbps, min_mbps);
+      status = EXIT_FAILURE;
+    }
+  }
+
+  if (!matched) {
+    fprintf(stderr, "ccsim: unknown congestion controller: %s\n", cc);
+    return EXIT_FAILURE;
+  }
+
+  return status;
+}
@@ -49,6 +49,15 @@
 #include "ngtcp2_pv_test.h"
 #include "ngtcp2_pmtud_test.h"
 #include "ngtcp2_str_test.h"
+#include "ngtcp2_qlog_test.h"
+#include "ngtcp2_log_test.h"
+#include "ngtcp2_ppe_test.h"
+#include "ngtcp2_cc_test.h"
+#include "ngtcp2_mem_test.h"
+#include "ngtcp2_seqlock_test.h"
+#include "ngtcp2_cpu_test.h"
+#include "ngtcp2_pq_test.h"
+#include "ngtcp2_cycleq_test.h"
 
 static int init_suite1(void) { return 0; }
 
@@ -74,6 +83,8 @@ int main(void) {
   /* add the tests to the suite */
   if (!CU_add_test(pSuite, "pkt_decode_version_cid",
                    test_ngtcp2_pkt_decode_version_cid) ||
+      !CU_add_test(pSuite, "pkt_group_by_dcid",
+                   test_ngtcp2_pkt_group_by_dcid) ||
       !CU_add_test(pSuite, "pkt_decode_hd_long",
                    test_ngtcp2_pkt_decode_hd_long) ||
       !CU_add_test(pSuite, "pkt_decode_hd_short",
@@ -128,6 +139,12 @@ int main(void) {
                    test_ngtcp2_pkt_encode_handshake_done_frame) ||
       !CU_add_test(pSuite, "pkt_encode_datagram_frame",
                    test_ngtcp2_pkt_encode_datagram_frame) ||
+      !CU_add_test(pSuite, "pkt_encode_ack_frequency_frame",
+                   test_ngtcp2_pkt_encode_ack_frequency_frame) ||
+      !CU_add_test(pSuite, "pkt_encode_immediate_ack_frame",
+                   test_ngtcp2_pkt_encode_immediate_ack_frame) ||
+      !CU_add_test(pSuite, "pkt_encode_repair_frame",
+                   test_ngtcp2_pkt_encode_repair_frame) ||
       !CU_add_test(pSuite, "pkt_adjust_pkt_num",
                    test_ngtcp2_pkt_adjust_pkt_num) ||
       !CU_add_test(pSuite, "pkt_validate_ack", test_ngtcp2_pkt_validate_ack) ||
@@ -139,6 +156,7 @@ int main(void) {
       !CU_add_test(pSuite, "pkt_stream_max_datalen",
                    test_ngtcp2_pkt_stream_max_datalen) ||
       !CU_add_test(pSuite, "get_varint", test_ngtcp2_get_varint) ||
+      !CU_add_test(pSuite, "get_varints", test_ngtcp2_get_varints) ||
       !CU_add_test(pSuite, "get_varint_len", test_ngtcp2_get_varint_len) ||
       !CU_add_test(pSuite, "put_varint_len", test_ngtcp2_put_varint_len) ||
       !CU_add_test(pSuite, "nth_server_bidi_id",
@@ -159,31 +177,46 @@ int main(void) {
                    test_ngtcp2_ksl_update_key_range) ||
       !CU_add_test(pSuite, "ksl_dup", test_ngtcp2_ksl_dup) ||
       !CU_add_test(pSuite, "ksl_remove_hint", test_ngtcp2_ksl_remove_hint) ||
+      !CU_add_test(pSuite, "ksl_int64", test_ngtcp2_ksl_int64) ||
       !CU_add_test(pSuite, "rob_push", test_ngtcp2_rob_push) ||
       !CU_add_test(pSuite, "rob_push_random", test_ngtcp2_rob_push_random) ||
       !CU_add_test(pSuite, "rob_data_at", test_ngtcp2_rob_data_at) ||
+      !CU_add_test(pSuite, "rob_sparse", test_ngtcp2_rob_sparse) ||
+      !CU_add_test(pSuite, "rob_loan", test_ngtcp2_rob_loan) ||
+      !CU_add_test(pSuite, "rob_cache", test_ngtcp2_rob_cache) ||
       !CU_add_test(pSuite, "rob_remove_prefix",
                    test_ngtcp2_rob_remove_prefix) ||
       !CU_add_test(pSuite, "acktr_add", test_ngtcp2_acktr_add) ||
       !CU_add_test(pSuite, "acktr_eviction", test_ngtcp2_acktr_eviction) ||
+      !CU_add_test(pSuite, "acktr_grow", test_ngtcp2_acktr_grow) ||
       !CU_add_test(pSuite, "acktr_forget", test_ngtcp2_acktr_forget) ||
       !CU_add_test(pSuite, "acktr_recv_ack", test_ngtcp2_acktr_recv_ack) ||
       !CU_add_test(pSuite, "encode_transport_params",
                    test_ngtcp2_encode_transport_params) ||
+      !CU_add_test(pSuite, "encode_transport_params_template",
+                   test_ngtcp2_encode_transport_params_template) ||
       !CU_add_test(pSuite, "decode_transport_params_new",
                    test_ngtcp2_decode_transport_params_new) ||
+      !CU_add_test(pSuite, "transport_params_storage_copy",
+                   test_ngtcp2_transport_params_storage_copy) ||
+      !CU_add_test(pSuite, "frame_chain_size_class",
+                   test_ngtcp2_frame_chain_size_class) ||
       !CU_add_test(pSuite, "rtb_add", test_ngtcp2_rtb_add) ||
+      !CU_add_test(pSuite, "rtb_ents", test_ngtcp2_rtb_ents) ||
       !CU_add_test(pSuite, "rtb_recv_ack", test_ngtcp2_rtb_recv_ack) ||
       !CU_add_test(pSuite, "rtb_lost_pkt_ts", test_ngtcp2_rtb_lost_pkt_ts) ||
       !CU_add_test(pSuite, "rtb_remove_expired_lost_pkt",
                    test_ngtcp2_rtb_remove_expired_lost_pkt) ||
       !CU_add_test(pSuite, "rtb_remove_excessive_lost_pkt",
                    test_ngtcp2_rtb_remove_excessive_lost_pkt) ||
+      !CU_add_test(pSuite, "cryptofrq", test_ngtcp2_cryptofrq) ||
       !CU_add_test(pSuite, "idtr_open", test_ngtcp2_idtr_open) ||
+      !CU_add_test(pSuite, "idtr_window", test_ngtcp2_idtr_window) ||
       !CU_add_test(pSuite, "ringbuf_push_front",
                    test_ngtcp2_ringbuf_push_front) ||
       !CU_add_test(pSuite, "ringbuf_pop_front",
                    test_ngtcp2_ringbuf_pop_front) ||
+      !CU_add_test(pSuite, "ringbuf_reserve", test_ngtcp2_ringbuf_reserve) ||
       !CU_add_test(pSuite, "conn_stream_open_close",
                    test_ngtcp2_conn_stream_open_close) ||
       !CU_add_test(pSuite, "conn_stream_rx_flow_control",
@@ -196,6 +229,20 @@ int main(void) {
                    test_ngtcp2_conn_rx_flow_control) ||
       !CU_add_test(pSuite, "conn_rx_flow_control_error",
                    test_ngtcp2_conn_rx_flow_control_error) ||
+      !CU_add_test(pSuite, "conn_mem_budget", test_ngtcp2_conn_mem_budget) ||
+      !CU_add_test(pSuite, "conn_hibernate", test_ngtcp2_conn_hibernate) ||
+      !CU_add_test(pSuite, "conn_shared_pool", test_ngtcp2_conn_shared_pool) ||
+      !CU_add_test(pSuite, "conn_free_handshake_only_state",
+                   test_ngtcp2_conn_free_handshake_only_state) ||
+      !CU_add_test(pSuite, "conn_snapshot", test_ngtcp2_conn_snapshot) ||
+      !CU_add_test(pSuite, "conn_snapshot_aead_limit",
+                   test_ngtcp2_conn_snapshot_aead_limit) ||
+      !CU_add_test(pSuite, "conn_published_conn_stat",
+                   test_ngtcp2_conn_published_conn_stat) ||
+      !CU_add_test(pSuite, "conn_flow_window_autotuning",
+                   test_ngtcp2_conn_flow_window_autotuning) ||
+      !CU_add_test(pSuite, "conn_coalesce_flow_control_update",
+                   test_ngtcp2_conn_coalesce_flow_control_update) ||
       !CU_add_test(pSuite, "conn_tx_flow_control",
                    test_ngtcp2_conn_tx_flow_control) ||
       !CU_add_test(pSuite, "conn_shutdown_stream_write",
@@ -215,15 +262,22 @@ int main(void) {
                    test_ngtcp2_conn_recv_delayed_handshake_pkt) ||
       !CU_add_test(pSuite, "conn_recv_max_streams",
                    test_ngtcp2_conn_recv_max_streams) ||
+      !CU_add_test(pSuite, "conn_auto_max_streams",
+                   test_ngtcp2_conn_auto_max_streams) ||
       !CU_add_test(pSuite, "conn_handshake", test_ngtcp2_conn_handshake) ||
       !CU_add_test(pSuite, "conn_handshake_error",
                    test_ngtcp2_conn_handshake_error) ||
+      !CU_add_test(pSuite, "conn_retransmit_first",
+                   test_ngtcp2_conn_retransmit_first) ||
       !CU_add_test(pSuite, "conn_retransmit_protected",
                    test_ngtcp2_conn_retransmit_protected) ||
       !CU_add_test(pSuite, "conn_send_max_stream_data",
                    test_ngtcp2_conn_send_max_stream_data) ||
       !CU_add_test(pSuite, "conn_recv_stream_data",
                    test_ngtcp2_conn_recv_stream_data) ||
+      !CU_add_test(pSuite, "conn_read_pkts", test_ngtcp2_conn_read_pkts) ||
+      !CU_add_test(pSuite, "conn_decrypt_in_place",
+                   test_ngtcp2_conn_decrypt_in_place) ||
       !CU_add_test(pSuite, "conn_recv_ping", test_ngtcp2_conn_recv_ping) ||
       !CU_add_test(pSuite, "conn_recv_max_stream_data",
                    test_ngtcp2_conn_recv_max_stream_data) ||
@@ -239,25 +293,49 @@ int main(void) {
                    test_ngtcp2_conn_writev_stream) ||
       !CU_add_test(pSuite, "conn_writev_datagram",
                    test_ngtcp2_conn_writev_datagram) ||
+      !CU_add_test(pSuite, "conn_protect_pkts",
+                   test_ngtcp2_conn_protect_pkts) ||
+      !CU_add_test(pSuite, "conn_protect_job", test_ngtcp2_conn_protect_job) ||
+      !CU_add_test(pSuite, "conn_prepare_rx_hp_masks",
+                   test_ngtcp2_conn_prepare_rx_hp_masks) ||
+      !CU_add_test(pSuite, "conn_enqueue_datagram",
+                   test_ngtcp2_conn_enqueue_datagram) ||
       !CU_add_test(pSuite, "conn_recv_datagram",
                    test_ngtcp2_conn_recv_datagram) ||
+      !CU_add_test(pSuite, "conn_recv_ack_frequency",
+                   test_ngtcp2_conn_recv_ack_frequency) ||
+      !CU_add_test(pSuite, "conn_recv_ecn_ce", test_ngtcp2_conn_recv_ecn_ce) ||
+      !CU_add_test(pSuite, "conn_spin_bit", test_ngtcp2_conn_spin_bit) ||
+      !CU_add_test(pSuite, "conn_fec", test_ngtcp2_conn_fec) ||
       !CU_add_test(pSuite, "conn_recv_new_connection_id",
                    test_ngtcp2_conn_recv_new_connection_id) ||
       !CU_add_test(pSuite, "conn_recv_retire_connection_id",
                    test_ngtcp2_conn_recv_retire_connection_id) ||
+      !CU_add_test(pSuite, "conn_get_new_connection_ids",
+                   test_ngtcp2_conn_get_new_connection_ids) ||
       !CU_add_test(pSuite, "conn_server_path_validation",
                    test_ngtcp2_conn_server_path_validation) ||
+      !CU_add_test(pSuite, "conn_get_path_stat",
+                   test_ngtcp2_conn_get_path_stat) ||
       !CU_add_test(pSuite, "conn_client_connection_migration",
                    test_ngtcp2_conn_client_connection_migration) ||
       !CU_add_test(pSuite, "conn_recv_path_challenge",
                    test_ngtcp2_conn_recv_path_challenge) ||
       !CU_add_test(pSuite, "conn_key_update", test_ngtcp2_conn_key_update) ||
+      !CU_add_test(pSuite, "conn_eager_key_update",
+                   test_ngtcp2_conn_eager_key_update) ||
+      !CU_add_test(pSuite, "conn_auto_key_update",
+                   test_ngtcp2_conn_auto_key_update) ||
+      !CU_add_test(pSuite, "conn_crypto_offload",
+                   test_ngtcp2_conn_crypto_offload) ||
       !CU_add_test(pSuite, "conn_crypto_buffer_exceeded",
                    test_ngtcp2_conn_crypto_buffer_exceeded) ||
       !CU_add_test(pSuite, "conn_handshake_probe",
                    test_ngtcp2_conn_handshake_probe) ||
       !CU_add_test(pSuite, "conn_handshake_loss",
                    test_ngtcp2_conn_handshake_loss) ||
+      !CU_add_test(pSuite, "conn_amplification_limit",
+                   test_ngtcp2_conn_amplification_limit) ||
       !CU_add_test(pSuite, "conn_recv_client_initial_retry",
                    test_ngtcp2_conn_recv_client_initial_retry) ||
       !CU_add_test(pSuite, "conn_recv_client_initial_token",
@@ -278,6 +356,8 @@ int main(void) {
                    test_ngtcp2_conn_rtb_reclaim_on_pto) ||
       !CU_add_test(pSuite, "conn_rtb_reclaim_on_pto_datagram",
                    test_ngtcp2_conn_rtb_reclaim_on_pto_datagram) ||
+      !CU_add_test(pSuite, "conn_pto_probe_policy",
+                   test_ngtcp2_conn_pto_probe_policy) ||
       !CU_add_test(pSuite, "conn_validate_ecn",
                    test_ngtcp2_conn_validate_ecn) ||
       !CU_add_test(pSuite, "conn_path_validation",
@@ -287,11 +367,36 @@ int main(void) {
       !CU_add_test(pSuite, "conn_early_data_rejected",
                    test_ngtcp2_conn_early_data_rejected) ||
       !CU_add_test(pSuite, "conn_keep_alive", test_ngtcp2_conn_keep_alive) ||
+      !CU_add_test(pSuite, "conn_keep_alive_external",
+                   test_ngtcp2_conn_keep_alive_external) ||
       !CU_add_test(pSuite, "conn_retire_stale_bound_dcid",
                    test_ngtcp2_conn_retire_stale_bound_dcid) ||
       !CU_add_test(pSuite, "conn_get_scid", test_ngtcp2_conn_get_scid) ||
       !CU_add_test(pSuite, "conn_stream_close",
                    test_ngtcp2_conn_stream_close) ||
+      !CU_add_test(pSuite, "conn_acked_stream_data_offset",
+                   test_ngtcp2_conn_acked_stream_data_offset) ||
+      !CU_add_test(pSuite, "conn_release_stream_buf",
+                   test_ngtcp2_conn_release_stream_buf) ||
+      !CU_add_test(pSuite, "conn_relay", test_ngtcp2_conn_relay) ||
+      !CU_add_test(pSuite, "conn_stream_sendbuf",
+                   test_ngtcp2_conn_stream_sendbuf) ||
+      !CU_add_test(pSuite, "conn_stream_sched",
+                   test_ngtcp2_conn_stream_sched) ||
+      !CU_add_test(pSuite, "conn_writev_streams",
+                   test_ngtcp2_conn_writev_streams) ||
+      !CU_add_test(pSuite, "conn_write_burst", test_ngtcp2_conn_write_burst) ||
+      !CU_add_test(pSuite, "conn_pkt_tx_time", test_ngtcp2_conn_pkt_tx_time) ||
+      !CU_add_test(pSuite, "conn_get_expiry", test_ngtcp2_conn_get_expiry) ||
+      !CU_add_test(pSuite, "conn_perf_stat", test_ngtcp2_conn_perf_stat) ||
+      !CU_add_test(pSuite, "conn_stall_stat", test_ngtcp2_conn_stall_stat) ||
+      !CU_add_test(pSuite, "conn_latency_stat",
+                   test_ngtcp2_conn_latency_stat) ||
+      !CU_add_test(pSuite, "conn_hol_stat", test_ngtcp2_conn_hol_stat) ||
+      !CU_add_test(pSuite, "conn_steady_state_alloc",
+                   test_ngtcp2_conn_steady_state_alloc) ||
+      !CU_add_test(pSuite, "conn_ack_frame_cache",
+                   test_ngtcp2_conn_ack_frame_cache) ||
       !CU_add_test(pSuite, "conn_buffer_pkt", test_ngtcp2_conn_buffer_pkt) ||
       !CU_add_test(pSuite, "conn_handshake_timeout",
                    test_ngtcp2_conn_handshake_timeout) ||
@@ -302,6 +407,16 @@ int main(void) {
       !CU_add_test(pSuite, "conn_server_negotiate_version",
                    test_ngtcp2_conn_server_negotiate_version) ||
       !CU_add_test(pSuite, "conn_pmtud_loss", test_ngtcp2_conn_pmtud_loss) ||
+      !CU_add_test(pSuite, "conn_pmtud_probe_data",
+                   test_ngtcp2_conn_pmtud_probe_data) ||
+      !CU_add_test(pSuite, "conn_pmtud_black_hole",
+                   test_ngtcp2_conn_pmtud_black_hole) ||
+      !CU_add_test(pSuite, "conn_user_cc", test_ngtcp2_conn_user_cc) ||
+      !CU_add_test(pSuite, "conn_cc_resume", test_ngtcp2_conn_cc_resume) ||
+      !CU_add_test(pSuite, "encode_cc_resume_params",
+                   test_ngtcp2_encode_cc_resume_params) ||
+      !CU_add_test(pSuite, "conn_spurious_loss",
+                   test_ngtcp2_conn_spurious_loss) ||
       !CU_add_test(pSuite, "conn_new_failmalloc",
                    test_ngtcp2_conn_new_failmalloc) ||
       !CU_add_test(pSuite, "accept", test_ngtcp2_accept) ||
@@ -312,24 +427,56 @@ int main(void) {
       !CU_add_test(pSuite, "map_functional", test_ngtcp2_map_functional) ||
       !CU_add_test(pSuite, "map_each_free", test_ngtcp2_map_each_free) ||
       !CU_add_test(pSuite, "map_clear", test_ngtcp2_map_clear) ||
+      !CU_add_test(pSuite, "map_shrink", test_ngtcp2_map_shrink) ||
       !CU_add_test(pSuite, "gaptr_push", test_ngtcp2_gaptr_push) ||
       !CU_add_test(pSuite, "gaptr_is_pushed", test_ngtcp2_gaptr_is_pushed) ||
       !CU_add_test(pSuite, "gaptr_drop_first_gap",
                    test_ngtcp2_gaptr_drop_first_gap) ||
       !CU_add_test(pSuite, "vec_split", test_ngtcp2_vec_split) ||
+      !CU_add_test(pSuite, "vec_split_at", test_ngtcp2_vec_split_at) ||
       !CU_add_test(pSuite, "vec_merge", test_ngtcp2_vec_merge) ||
       !CU_add_test(pSuite, "vec_len_varint", test_ngtcp2_vec_len_varint) ||
       !CU_add_test(pSuite, "strm_streamfrq_pop",
                    test_ngtcp2_strm_streamfrq_pop) ||
+      !CU_add_test(pSuite, "strm_streamfrq_push",
+                   test_ngtcp2_strm_streamfrq_push) ||
       !CU_add_test(pSuite, "strm_streamfrq_unacked_offset",
                    test_ngtcp2_strm_streamfrq_unacked_offset) ||
       !CU_add_test(pSuite, "strm_streamfrq_unacked_pop",
                    test_ngtcp2_strm_streamfrq_unacked_pop) ||
+      !CU_add_test(pSuite, "strm_pool", test_ngtcp2_strm_pool) ||
       !CU_add_test(pSuite, "pv_add_entry", test_ngtcp2_pv_add_entry) ||
       !CU_add_test(pSuite, "pv_validate", test_ngtcp2_pv_validate) ||
       !CU_add_test(pSuite, "pmtud_probe", test_ngtcp2_pmtud_probe) ||
+      !CU_add_test(pSuite, "pmtud_search", test_ngtcp2_pmtud_search) ||
       !CU_add_test(pSuite, "encode_ipv4", test_ngtcp2_encode_ipv4) ||
-      !CU_add_test(pSuite, "encode_ipv6", test_ngtcp2_encode_ipv6)) {
+      !CU_add_test(pSuite, "encode_ipv6", test_ngtcp2_encode_ipv6) ||
+#ifndef NOQLOG
+      !CU_add_test(pSuite, "qlog_binary", test_ngtcp2_qlog_binary) ||
+      !CU_add_test(pSuite, "qlog_filter", test_ngtcp2_qlog_filter) ||
+#endif /* NOQLOG */
+#ifndef NOLOG
+      !CU_add_test(pSuite, "log_record", test_ngtcp2_log_record) ||
+#endif /* NOLOG */
+      !CU_add_test(pSuite, "ppe_encode_hd_tmpl",
+                   test_ngtcp2_ppe_encode_hd_tmpl) ||
+      !CU_add_test(pSuite, "ppe_final_encrypt_hp_mask",
+                   test_ngtcp2_ppe_final_encrypt_hp_mask) ||
+      !CU_add_test(pSuite, "ppe_final_encrypt_vec",
+                   test_ngtcp2_ppe_final_encrypt_vec) ||
+      !CU_add_test(pSuite, "cc_hystart", test_ngtcp2_cc_hystart) ||
+      !CU_add_test(pSuite, "cc_prague", test_ngtcp2_cc_prague) ||
+      !CU_add_test(pSuite, "cc_reno_spurious_congestion",
+                   test_ngtcp2_cc_reno_spurious_congestion) ||
+      !CU_add_test(pSuite, "cc_cwnd_validation",
+                   test_ngtcp2_cc_cwnd_validation) ||
+      !CU_add_test(pSuite, "thread_arena", test_ngtcp2_thread_arena) ||
+      !CU_add_test(pSuite, "seqlock", test_ngtcp2_seqlock) ||
+      !CU_add_test(pSuite, "cpu_memxor", test_ngtcp2_cpu_memxor) ||
+      !CU_add_test(pSuite, "pq_arity", test_ngtcp2_pq_arity) ||
+      !CU_add_test(pSuite, "cycleq_round_robin",
+                   test_ngtcp2_cycleq_round_robin) ||
+      !CU_add_test(pSuite, "cycleq_remove", test_ngtcp2_cycleq_remove)) {
     CU_cleanup_registry();
     return (int)CU_get_error();
   }
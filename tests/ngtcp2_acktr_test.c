@@ -33,13 +33,12 @@ void test_ngtcp2_acktr_add(void) {
   const int64_t pkt_nums[] = {1, 5, 7, 6, 2, 3};
   ngtcp2_acktr acktr;
   ngtcp2_acktr_entry *ent;
-  ngtcp2_ksl_it it;
   size_t i;
   int rv;
   const ngtcp2_mem *mem = ngtcp2_mem_default();
   ngtcp2_log log;
 
-  ngtcp2_log_init(&log, NULL, NULL, 0, NULL);
+  ngtcp2_log_init(&log, NULL, NULL, NULL, 0, NULL);
   ngtcp2_acktr_init(&acktr, &log, mem);
 
   for (i = 0; i < arraylen(pkt_nums); ++i) {
@@ -48,22 +47,18 @@ void test_ngtcp2_acktr_add(void) {
     CU_ASSERT(0 == rv);
   }
 
-  it = ngtcp2_acktr_get(&acktr);
-  ent = ngtcp2_ksl_it_get(&it);
+  CU_ASSERT(2 == ngtcp2_acktr_len(&acktr));
+
+  ent = ngtcp2_acktr_get(&acktr, 0);
 
   CU_ASSERT(7 == ent->pkt_num);
   CU_ASSERT(3 == ent->len);
 
-  ngtcp2_ksl_it_next(&it);
-  ent = ngtcp2_ksl_it_get(&it);
+  ent = ngtcp2_acktr_get(&acktr, 1);
 
   CU_ASSERT(3 == ent->pkt_num);
   CU_ASSERT(3 == ent->len);
 
-  ngtcp2_ksl_it_next(&it);
-
-  CU_ASSERT(ngtcp2_ksl_it_end(&it));
-
   ngtcp2_acktr_free(&acktr);
 
   /* Check all conditions */
@@ -75,10 +70,9 @@ void test_ngtcp2_acktr_add(void) {
   ngtcp2_acktr_add(&acktr, 1, 1, 100);
   ngtcp2_acktr_add(&acktr, 0, 1, 101);
 
-  CU_ASSERT(1 == ngtcp2_ksl_len(&acktr.ents));
+  CU_ASSERT(1 == ngtcp2_acktr_len(&acktr));
 
-  it = ngtcp2_acktr_get(&acktr);
-  ent = ngtcp2_ksl_it_get(&it);
+  ent = ngtcp2_acktr_get(&acktr, 0);
 
   CU_ASSERT(1 == ent->pkt_num);
   CU_ASSERT(2 == ent->len);
@@ -93,10 +87,9 @@ void test_ngtcp2_acktr_add(void) {
   ngtcp2_acktr_add(&acktr, 0, 1, 100);
   ngtcp2_acktr_add(&acktr, 1, 1, 101);
 
-  CU_ASSERT(1 == ngtcp2_ksl_len(&acktr.ents));
+  CU_ASSERT(1 == ngtcp2_acktr_len(&acktr));
 
-  it = ngtcp2_acktr_get(&acktr);
-  ent = ngtcp2_ksl_it_get(&it);
+  ent = ngtcp2_acktr_get(&acktr, 0);
 
   CU_ASSERT(1 == ent->pkt_num);
   CU_ASSERT(2 == ent->len);
@@ -111,14 +104,13 @@ void test_ngtcp2_acktr_add(void) {
   ngtcp2_acktr_add(&acktr, 2, 1, 101);
   ngtcp2_acktr_add(&acktr, 3, 1, 102);
 
-  CU_ASSERT(2 == ngtcp2_ksl_len(&acktr.ents));
+  CU_ASSERT(2 == ngtcp2_acktr_len(&acktr));
 
   ngtcp2_acktr_add(&acktr, 1, 1, 103);
 
-  CU_ASSERT(1 == ngtcp2_ksl_len(&acktr.ents));
+  CU_ASSERT(1 == ngtcp2_acktr_len(&acktr));
 
-  it = ngtcp2_acktr_get(&acktr);
-  ent = ngtcp2_ksl_it_get(&it);
+  ent = ngtcp2_acktr_get(&acktr, 0);
 
   CU_ASSERT(3 == ent->pkt_num);
   CU_ASSERT(4 == ent->len);
@@ -134,21 +126,19 @@ void test_ngtcp2_acktr_add(void) {
   ngtcp2_acktr_add(&acktr, 3, 1, 101);
   ngtcp2_acktr_add(&acktr, 4, 1, 102);
 
-  CU_ASSERT(2 == ngtcp2_ksl_len(&acktr.ents));
+  CU_ASSERT(2 == ngtcp2_acktr_len(&acktr));
 
   ngtcp2_acktr_add(&acktr, 1, 1, 103);
 
-  CU_ASSERT(2 == ngtcp2_ksl_len(&acktr.ents));
+  CU_ASSERT(2 == ngtcp2_acktr_len(&acktr));
 
-  it = ngtcp2_acktr_get(&acktr);
-  ent = ngtcp2_ksl_it_get(&it);
+  ent = ngtcp2_acktr_get(&acktr, 0);
 
   CU_ASSERT(4 == ent->pkt_num);
   CU_ASSERT(2 == ent->len);
   CU_ASSERT(102 == ent->tstamp);
 
-  ngtcp2_ksl_it_next(&it);
-  ent = ngtcp2_ksl_it_get(&it);
+  ent = ngtcp2_acktr_get(&acktr, 1);
 
   CU_ASSERT(1 == ent->pkt_num);
   CU_ASSERT(2 == ent->len);
@@ -164,21 +154,19 @@ void test_ngtcp2_acktr_add(void) {
   ngtcp2_acktr_add(&acktr, 3, 1, 101);
   ngtcp2_acktr_add(&acktr, 4, 1, 102);
 
-  CU_ASSERT(2 == ngtcp2_ksl_len(&acktr.ents));
+  CU_ASSERT(2 == ngtcp2_acktr_len(&acktr));
 
   ngtcp2_acktr_add(&acktr, 2, 1, 103);
 
-  CU_ASSERT(2 == ngtcp2_ksl_len(&acktr.ents));
+  CU_ASSERT(2 == ngtcp2_acktr_len(&acktr));
 
-  it = ngtcp2_acktr_get(&acktr);
-  ent = ngtcp2_ksl_it_get(&it);
+  ent = ngtcp2_acktr_get(&acktr, 0);
 
   CU_ASSERT(4 == ent->pkt_num);
   CU_ASSERT(3 == ent->len);
   CU_ASSERT(102 == ent->tstamp);
 
-  ngtcp2_ksl_it_next(&it);
-  ent = ngtcp2_ksl_it_get(&it);
+  ent = ngtcp2_acktr_get(&acktr, 1);
 
   CU_ASSERT(0 == ent->pkt_num);
   CU_ASSERT(1 == ent->len);
@@ -193,7 +181,7 @@ void test_ngtcp2_acktr_add(void) {
   ngtcp2_acktr_add(&acktr, 4, 1, 0);
   ngtcp2_acktr_add(&acktr, 2, 1, 0);
 
-  CU_ASSERT(3 == ngtcp2_ksl_len(&acktr.ents));
+  CU_ASSERT(3 == ngtcp2_acktr_len(&acktr));
 
   ngtcp2_acktr_free(&acktr);
 }
@@ -205,20 +193,18 @@ void test_ngtcp2_acktr_eviction(void) {
   ngtcp2_acktr_entry *ent;
   const size_t extra = 17;
   ngtcp2_log log;
-  ngtcp2_ksl_it it;
 
-  ngtcp2_log_init(&log, NULL, NULL, 0, NULL);
+  ngtcp2_log_init(&log, NULL, NULL, NULL, 0, NULL);
   ngtcp2_acktr_init(&acktr, &log, mem);
 
   for (i = 0; i < NGTCP2_ACKTR_MAX_ENT + extra; ++i) {
     ngtcp2_acktr_add(&acktr, (int64_t)(i * 2), 1, 999 + i);
   }
 
-  CU_ASSERT(NGTCP2_ACKTR_MAX_ENT == ngtcp2_ksl_len(&acktr.ents));
+  CU_ASSERT(NGTCP2_ACKTR_MAX_ENT == ngtcp2_acktr_len(&acktr));
 
-  for (i = 0, it = ngtcp2_acktr_get(&acktr); !ngtcp2_ksl_it_end(&it);
-       ++i, ngtcp2_ksl_it_next(&it)) {
-    ent = ngtcp2_ksl_it_get(&it);
+  for (i = 0; i < ngtcp2_acktr_len(&acktr); ++i) {
+    ent = ngtcp2_acktr_get(&acktr, i);
 
     CU_ASSERT((int64_t)((NGTCP2_ACKTR_MAX_ENT + extra - 1) * 2 - i * 2) ==
               ent->pkt_num);
@@ -233,11 +219,10 @@ void test_ngtcp2_acktr_eviction(void) {
     ngtcp2_acktr_add(&acktr, (int64_t)((i - 1) * 2), 1, 999 + i);
   }
 
-  CU_ASSERT(NGTCP2_ACKTR_MAX_ENT == ngtcp2_ksl_len(&acktr.ents));
+  CU_ASSERT(NGTCP2_ACKTR_MAX_ENT == ngtcp2_acktr_len(&acktr));
 
-  for (i = 0, it = ngtcp2_acktr_get(&acktr); !ngtcp2_ksl_it_end(&it);
-       ++i, ngtcp2_ksl_it_next(&it)) {
-    ent = ngtcp2_ksl_it_get(&it);
+  for (i = 0; i < ngtcp2_acktr_len(&acktr); ++i) {
+    ent = ngtcp2_acktr_get(&acktr, i);
 
     CU_ASSERT((int64_t)((NGTCP2_ACKTR_MAX_ENT + extra - 1) * 2 - i * 2) ==
               ent->pkt_num);
@@ -246,53 +231,80 @@ void test_ngtcp2_acktr_eviction(void) {
   ngtcp2_acktr_free(&acktr);
 }
 
+void test_ngtcp2_acktr_grow(void) {
+  ngtcp2_acktr acktr;
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  size_t i;
+  ngtcp2_acktr_entry *ent;
+  ngtcp2_log log;
+  int rv;
+
+  ngtcp2_log_init(&log, NULL, NULL, NULL, 0, NULL);
+  ngtcp2_acktr_init(&acktr, &log, mem);
+
+  for (i = 0; i < 100; ++i) {
+    rv = ngtcp2_acktr_add(&acktr, (int64_t)(i * 2), 1, 999);
+
+    CU_ASSERT(0 == rv);
+  }
+
+  CU_ASSERT(100 == ngtcp2_acktr_len(&acktr));
+
+  /* Fill the gaps in an order which inserts and removes entries on
+     both sides of the ring buffer. */
+  for (i = 0; i < 99; ++i) {
+    rv = ngtcp2_acktr_add(&acktr,
+                          (int64_t)(((i % 2) ? 98 - i / 2 : i / 2) * 2 + 1),
+                          1, 999);
+
+    CU_ASSERT(0 == rv);
+  }
+
+  CU_ASSERT(1 == ngtcp2_acktr_len(&acktr));
+
+  ent = ngtcp2_acktr_get(&acktr, 0);
+
+  CU_ASSERT(198 == ent->pkt_num);
+  CU_ASSERT(199 == ent->len);
+
+  ngtcp2_acktr_free(&acktr);
+}
+
 void test_ngtcp2_acktr_forget(void) {
   ngtcp2_acktr acktr;
   const ngtcp2_mem *mem = ngtcp2_mem_default();
   size_t i;
   ngtcp2_acktr_entry *ent;
   ngtcp2_log log;
-  ngtcp2_ksl_it it;
 
-  ngtcp2_log_init(&log, NULL, NULL, 0, NULL);
+  ngtcp2_log_init(&log, NULL, NULL, NULL, 0, NULL);
   ngtcp2_acktr_init(&acktr, &log, mem);
 
   for (i = 0; i < 7; ++i) {
     ngtcp2_acktr_add(&acktr, (int64_t)(i * 2), 1, 999 + i);
   }
 
-  CU_ASSERT(7 == ngtcp2_ksl_len(&acktr.ents));
+  CU_ASSERT(7 == ngtcp2_acktr_len(&acktr));
 
-  it = ngtcp2_acktr_get(&acktr);
-  ngtcp2_ksl_it_next(&it);
-  ngtcp2_ksl_it_next(&it);
-  ngtcp2_ksl_it_next(&it);
-  ent = ngtcp2_ksl_it_get(&it);
-  ngtcp2_acktr_forget(&acktr, ent);
+  ngtcp2_acktr_forget(&acktr, 3);
 
-  CU_ASSERT(3 == ngtcp2_ksl_len(&acktr.ents));
+  CU_ASSERT(3 == ngtcp2_acktr_len(&acktr));
 
-  it = ngtcp2_acktr_get(&acktr);
-  ent = ngtcp2_ksl_it_get(&it);
+  ent = ngtcp2_acktr_get(&acktr, 0);
 
   CU_ASSERT(12 == ent->pkt_num);
 
-  ngtcp2_ksl_it_next(&it);
-  ent = ngtcp2_ksl_it_get(&it);
+  ent = ngtcp2_acktr_get(&acktr, 1);
 
   CU_ASSERT(10 == ent->pkt_num);
 
-  ngtcp2_ksl_it_next(&it);
-  ent = ngtcp2_ksl_it_get(&it);
+  ent = ngtcp2_acktr_get(&acktr, 2);
 
   CU_ASSERT(8 == ent->pkt_num);
 
-  it = ngtcp2_acktr_get(&acktr);
-  ent = ngtcp2_ksl_it_get(&it);
-
-  ngtcp2_acktr_forget(&acktr, ent);
+  ngtcp2_acktr_forget(&acktr, 0);
 
-  CU_ASSERT(0 == ngtcp2_ksl_len(&acktr.ents));
+  CU_ASSERT(0 == ngtcp2_acktr_len(&acktr));
 
   ngtcp2_acktr_free(&acktr);
 }
@@ -315,16 +327,15 @@ void test_ngtcp2_acktr_recv_ack(void) {
   */
   ngtcp2_acktr_entry *ent;
   ngtcp2_log log;
-  ngtcp2_ksl_it it;
 
-  ngtcp2_log_init(&log, NULL, NULL, 0, NULL);
+  ngtcp2_log_init(&log, NULL, NULL, NULL, 0, NULL);
   ngtcp2_acktr_init(&acktr, &log, mem);
 
   for (i = 0; i < arraylen(rpkt_nums); ++i) {
     ngtcp2_acktr_add(&acktr, rpkt_nums[i], 1, 999 + i);
   }
 
-  CU_ASSERT(6 == ngtcp2_ksl_len(&acktr.ents));
+  CU_ASSERT(6 == ngtcp2_acktr_len(&acktr));
 
   ngtcp2_acktr_add_ack(&acktr, 998, 4497);
   ngtcp2_acktr_add_ack(&acktr, 999, 4499);
@@ -338,10 +349,9 @@ void test_ngtcp2_acktr_recv_ack(void) {
   ngtcp2_acktr_recv_ack(&acktr, &ackfr);
 
   CU_ASSERT(1 == ngtcp2_ringbuf_len(&acktr.acks));
-  CU_ASSERT(1 == ngtcp2_ksl_len(&acktr.ents));
+  CU_ASSERT(1 == ngtcp2_acktr_len(&acktr));
 
-  it = ngtcp2_ksl_begin(&acktr.ents);
-  ent = ngtcp2_ksl_it_get(&it);
+  ent = ngtcp2_acktr_get(&acktr, 0);
 
   CU_ASSERT(4500 == ent->pkt_num);
   CU_ASSERT(2 == ent->len);
@@ -355,10 +365,9 @@ void test_ngtcp2_acktr_recv_ack(void) {
   ngtcp2_acktr_recv_ack(&acktr, &ackfr);
 
   CU_ASSERT(0 == ngtcp2_ringbuf_len(&acktr.acks));
-  CU_ASSERT(1 == ngtcp2_ksl_len(&acktr.ents));
+  CU_ASSERT(1 == ngtcp2_acktr_len(&acktr));
 
-  it = ngtcp2_ksl_begin(&acktr.ents);
-  ent = ngtcp2_ksl_it_get(&it);
+  ent = ngtcp2_acktr_get(&acktr, 0);
 
   CU_ASSERT(4500 == ent->pkt_num);
   CU_ASSERT(1 == ent->len);
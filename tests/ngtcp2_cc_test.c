@@ -0,0 +1,421 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_cc_test.h"
+
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+
+#include "ngtcp2_cc.h"
+#include "ngtcp2_log.h"
+#include "ngtcp2_macro.h"
+#include "ngtcp2_test_helper.h"
+
+typedef int (*cc_init)(ngtcp2_cc *cc, ngtcp2_log *log, int hystart,
+                       int cwnd_validation, const ngtcp2_mem *mem);
+
+typedef void (*cc_free)(ngtcp2_cc *cc, const ngtcp2_mem *mem);
+
+static void hs_init_conn_stat(ngtcp2_conn_stat *cstat) {
+  memset(cstat, 0, sizeof(*cstat));
+  cstat->max_udp_payload_size = 1200;
+  cstat->cwnd = 20 * 1200;
+  cstat->ssthresh = UINT64_MAX;
+  cstat->congestion_recovery_start_ts = UINT64_MAX;
+  cstat->min_rtt = UINT64_MAX;
+  cstat->ss_exit_reason = NGTCP2_SS_EXIT_REASON_NONE;
+  cstat->ss_exit_ts = UINT64_MAX;
+}
+
+/*
+ * hs_ack acknowledges packet |pkt_num| which was sent when the
+ * sender was cwnd limited.
+ */
+static void hs_ack(ngtcp2_cc *cc, ngtcp2_conn_stat *cstat, int64_t pkt_num,
+                   ngtcp2_tstamp ts) {
+  ngtcp2_cc_pkt pkt;
+
+  cc->on_pkt_acked(cc, cstat,
+                   ngtcp2_cc_pkt_init(&pkt, pkt_num, 1200,
+                                      NGTCP2_PKTNS_ID_APPLICATION, 0, 0,
+                                      cstat->cwnd, 0),
+                   ts);
+}
+
+/*
+ * hs_round acknowledges the first packet of the previous batch,
+ * which ends the previous round.  Then it sends a batch of 10
+ * packets, which starts a new round, and acknowledges the rest of
+ * the previous batch with RTT sample |rtt|.
+ */
+static void hs_round(ngtcp2_cc *cc, ngtcp2_conn_stat *cstat,
+                     int64_t *ppkt_num, ngtcp2_duration rtt,
+                     ngtcp2_tstamp *pts) {
+  ngtcp2_cc_pkt pkt;
+  int64_t prev = *ppkt_num - 10;
+  int64_t i;
+
+  if (prev >= 0) {
+    hs_ack(cc, cstat, prev, *pts);
+  }
+
+  for (i = 0; i < 10; ++i) {
+    cc->on_pkt_sent(cc, cstat,
+                    ngtcp2_cc_pkt_init(&pkt, (*ppkt_num)++, 1200,
+                                       NGTCP2_PKTNS_ID_APPLICATION, *pts, 0, 0,
+                                       0));
+  }
+
+  if (prev < 0) {
+    return;
+  }
+
+  for (i = prev + 1; i < prev + 10; ++i) {
+    cstat->latest_rtt = rtt;
+    cc->new_rtt_sample(cc, cstat, *pts);
+    hs_ack(cc, cstat, i, *pts);
+  }
+
+  *pts += rtt;
+}
+
+static void check_hystart(cc_init ccinit, cc_free ccfree) {
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  ngtcp2_log log;
+  ngtcp2_cc cc;
+  ngtcp2_conn_stat cstat;
+  ngtcp2_tstamp t = 0;
+  int64_t pkt_num = 0;
+  uint64_t cwnd;
+  size_t i;
+
+  ngtcp2_log_init(&log, NULL, NULL, NULL, 0, NULL);
+
+  /* RTT increase is confirmed after Conservative Slow Start. */
+  hs_init_conn_stat(&cstat);
+  ccinit(&cc, &log, /* hystart = */ 1, /* cwnd_validation = */ 0, mem);
+
+  hs_round(&cc, &cstat, &pkt_num, 100 * NGTCP2_MILLISECONDS, &t);
+  hs_round(&cc, &cstat, &pkt_num, 100 * NGTCP2_MILLISECONDS, &t);
+  hs_round(&cc, &cstat, &pkt_num, 100 * NGTCP2_MILLISECONDS, &t);
+
+  CU_ASSERT(0 == cstat.hystart_css_count);
+  CU_ASSERT((20 + 20) * 1200 == cstat.cwnd);
+
+  /* 100ms / 8 = 12.5ms increase enters Conservative Slow Start at
+     the 8th RTT sample. */
+  hs_round(&cc, &cstat, &pkt_num, 113 * NGTCP2_MILLISECONDS, &t);
+
+  CU_ASSERT(1 == cstat.hystart_css_count);
+  CU_ASSERT((20 + 29) * 1200 + 1200 / 4 == cstat.cwnd);
+  CU_ASSERT(UINT64_MAX == cstat.ssthresh);
+
+  for (i = 0; i < 5; ++i) {
+    cwnd = cstat.cwnd;
+
+    hs_round(&cc, &cstat, &pkt_num, 113 * NGTCP2_MILLISECONDS, &t);
+
+    if (i < 4) {
+      CU_ASSERT(cwnd + 10 * 1200 / 4 == cstat.cwnd);
+      CU_ASSERT(UINT64_MAX == cstat.ssthresh);
+    }
+  }
+
+  CU_ASSERT(NGTCP2_SS_EXIT_REASON_HYSTART == cstat.ss_exit_reason);
+  CU_ASSERT(UINT64_MAX != cstat.ss_exit_ts);
+  CU_ASSERT(cstat.ss_exit_cwnd == cstat.ssthresh);
+  CU_ASSERT(cstat.cwnd >= cstat.ssthresh);
+  CU_ASSERT(0 == cstat.hystart_css_spurious_count);
+
+  ccfree(&cc, mem);
+
+  /* RTT decreases in Conservative Slow Start. */
+  hs_init_conn_stat(&cstat);
+  ccinit(&cc, &log, /* hystart = */ 1, /* cwnd_validation = */ 0, mem);
+  pkt_num = 0;
+
+  hs_round(&cc, &cstat, &pkt_num, 100 * NGTCP2_MILLISECONDS, &t);
+  hs_round(&cc, &cstat, &pkt_num, 100 * NGTCP2_MILLISECONDS, &t);
+  hs_round(&cc, &cstat, &pkt_num, 100 * NGTCP2_MILLISECONDS, &t);
+  hs_round(&cc, &cstat, &pkt_num, 120 * NGTCP2_MILLISECONDS, &t);
+
+  CU_ASSERT(1 == cstat.hystart_css_count);
+
+  hs_round(&cc, &cstat, &pkt_num, 110 * NGTCP2_MILLISECONDS, &t);
+
+  CU_ASSERT(1 == cstat.hystart_css_spurious_count);
+
+  cwnd = cstat.cwnd;
+
+  hs_round(&cc, &cstat, &pkt_num, 110 * NGTCP2_MILLISECONDS, &t);
+
+  CU_ASSERT(cwnd + 10 * 1200 == cstat.cwnd);
+  CU_ASSERT(NGTCP2_SS_EXIT_REASON_NONE == cstat.ss_exit_reason);
+
+  /* Packet loss ends slow start. */
+  cwnd = cstat.cwnd;
+  cc.congestion_event(&cc, &cstat, t, t);
+
+  CU_ASSERT(NGTCP2_SS_EXIT_REASON_LOSS == cstat.ss_exit_reason);
+  CU_ASSERT(t == cstat.ss_exit_ts);
+  CU_ASSERT(cwnd == cstat.ss_exit_cwnd);
+  CU_ASSERT(cwnd > cstat.cwnd);
+
+  ccfree(&cc, mem);
+
+  /* HyStart++ is disabled. */
+  hs_init_conn_stat(&cstat);
+  ccinit(&cc, &log, /* hystart = */ 0, /* cwnd_validation = */ 0, mem);
+  pkt_num = 0;
+
+  hs_round(&cc, &cstat, &pkt_num, 100 * NGTCP2_MILLISECONDS, &t);
+  hs_round(&cc, &cstat, &pkt_num, 100 * NGTCP2_MILLISECONDS, &t);
+  hs_round(&cc, &cstat, &pkt_num, 100 * NGTCP2_MILLISECONDS, &t);
+  hs_round(&cc, &cstat, &pkt_num, 200 * NGTCP2_MILLISECONDS, &t);
+
+  CU_ASSERT(0 == cstat.hystart_css_count);
+  CU_ASSERT((20 + 30) * 1200 == cstat.cwnd);
+
+  ccfree(&cc, mem);
+}
+
+void test_ngtcp2_cc_hystart(void) {
+  check_hystart(ngtcp2_cc_reno_cc_init, ngtcp2_cc_reno_cc_free);
+  check_hystart(ngtcp2_cc_cubic_cc_init, ngtcp2_cc_cubic_cc_free);
+  check_hystart(ngtcp2_cc_prague_cc_init, ngtcp2_cc_prague_cc_free);
+}
+
+void test_ngtcp2_cc_prague(void) {
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  ngtcp2_log log;
+  ngtcp2_cc cc;
+  ngtcp2_conn_stat cstat;
+  ngtcp2_prague_cc *prague_cc;
+  uint64_t cwnd;
+
+  ngtcp2_log_init(&log, NULL, NULL, NULL, 0, NULL);
+
+  hs_init_conn_stat(&cstat);
+  ngtcp2_cc_prague_cc_init(&cc, &log, /* hystart = */ 1,
+                           /* cwnd_validation = */ 0, mem);
+  prague_cc = ngtcp2_struct_of(cc.ccb, ngtcp2_prague_cc, reno.ccb);
+
+  CU_ASSERT(NGTCP2_PRAGUE_ALPHA_MAX == prague_cc->alpha);
+
+  /* The first ACK_ECN starts a round. */
+  cc.on_ecn_ack(&cc, &cstat, 10, 0, 0, 100 * NGTCP2_MILLISECONDS);
+
+  CU_ASSERT(20 * 1200 == cstat.cwnd);
+  CU_ASSERT(100 * NGTCP2_MILLISECONDS == prague_cc->round_start_ts);
+
+  /* CE marking halves cwnd while alpha is still at its initial
+     value. */
+  cc.on_ecn_ack(&cc, &cstat, 9, 1, 50 * NGTCP2_MILLISECONDS,
+                150 * NGTCP2_MILLISECONDS);
+
+  CU_ASSERT(10 * 1200 == cstat.cwnd);
+  CU_ASSERT(cstat.cwnd == cstat.ssthresh);
+  CU_ASSERT(150 * NGTCP2_MILLISECONDS == cstat.congestion_recovery_start_ts);
+  CU_ASSERT(NGTCP2_SS_EXIT_REASON_LOSS == cstat.ss_exit_reason);
+  CU_ASSERT(NGTCP2_PRAGUE_ALPHA_MAX == prague_cc->alpha);
+
+  /* A packet sent after the round started is acknowledged, which
+     ends the round.  1 out of 30 packets was CE marked. */
+  cc.on_ecn_ack(&cc, &cstat, 10, 0, 120 * NGTCP2_MILLISECONDS,
+                200 * NGTCP2_MILLISECONDS);
+
+  CU_ASSERT(1024 - 64 + 64 / 30 == prague_cc->alpha);
+  CU_ASSERT(200 * NGTCP2_MILLISECONDS == prague_cc->round_start_ts);
+  CU_ASSERT(0 == prague_cc->ect_acked);
+  CU_ASSERT(0 == prague_cc->ce_acked);
+
+  /* cwnd is reduced at most once per RTT. */
+  cc.on_ecn_ack(&cc, &cstat, 0, 1, 140 * NGTCP2_MILLISECONDS,
+                210 * NGTCP2_MILLISECONDS);
+
+  CU_ASSERT(10 * 1200 == cstat.cwnd);
+
+  /* The reduction is scaled by alpha. */
+  cc.on_ecn_ack(&cc, &cstat, 0, 1, 160 * NGTCP2_MILLISECONDS,
+                220 * NGTCP2_MILLISECONDS);
+
+  CU_ASSERT(10 * 1200 - ((10 * 1200 * prague_cc->alpha) >> 11) == cstat.cwnd);
+  CU_ASSERT(220 * NGTCP2_MILLISECONDS == cstat.congestion_recovery_start_ts);
+
+  /* The next round ends.  2 out of 12 packets were CE marked. */
+  cc.on_ecn_ack(&cc, &cstat, 10, 0, 210 * NGTCP2_MILLISECONDS,
+                300 * NGTCP2_MILLISECONDS);
+
+  CU_ASSERT(962 - 60 + 2 * 64 / 12 == prague_cc->alpha);
+
+  /* Packet loss reduces cwnd like Reno. */
+  cstat.cwnd = 20 * 1200;
+  cc.congestion_event(&cc, &cstat, 250 * NGTCP2_MILLISECONDS,
+                      300 * NGTCP2_MILLISECONDS);
+
+  CU_ASSERT(10 * 1200 == cstat.cwnd);
+
+  /* The loss turns out to be spurious. */
+  cc.on_spurious_congestion(&cc, &cstat, 310 * NGTCP2_MILLISECONDS);
+
+  CU_ASSERT(20 * 1200 == cstat.cwnd);
+  CU_ASSERT(UINT64_MAX == cstat.congestion_recovery_start_ts);
+
+  /* The reduction by CE marking is never undone. */
+  cc.congestion_event(&cc, &cstat, 320 * NGTCP2_MILLISECONDS,
+                      400 * NGTCP2_MILLISECONDS);
+  cc.on_ecn_ack(&cc, &cstat, 0, 1, 410 * NGTCP2_MILLISECONDS,
+                500 * NGTCP2_MILLISECONDS);
+  cwnd = cstat.cwnd;
+  cc.on_spurious_congestion(&cc, &cstat, 510 * NGTCP2_MILLISECONDS);
+
+  CU_ASSERT(cwnd == cstat.cwnd);
+
+  ngtcp2_cc_prague_cc_free(&cc, mem);
+}
+
+void test_ngtcp2_cc_reno_spurious_congestion(void) {
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  ngtcp2_log log;
+  ngtcp2_cc cc;
+  ngtcp2_conn_stat cstat;
+
+  ngtcp2_log_init(&log, NULL, NULL, NULL, 0, NULL);
+
+  hs_init_conn_stat(&cstat);
+  ngtcp2_cc_reno_cc_init(&cc, &log, /* hystart = */ 0,
+                         /* cwnd_validation = */ 0, mem);
+
+  cstat.cwnd = 20 * 1200;
+  cstat.ssthresh = UINT64_MAX;
+
+  cc.congestion_event(&cc, &cstat, 0, 100 * NGTCP2_MILLISECONDS);
+
+  CU_ASSERT(10 * 1200 == cstat.cwnd);
+  CU_ASSERT(10 * 1200 == cstat.ssthresh);
+
+  cc.on_spurious_congestion(&cc, &cstat, 110 * NGTCP2_MILLISECONDS);
+
+  CU_ASSERT(20 * 1200 == cstat.cwnd);
+  CU_ASSERT(UINT64_MAX == cstat.ssthresh);
+  CU_ASSERT(UINT64_MAX == cstat.congestion_recovery_start_ts);
+
+  /* Nothing to undo */
+  cc.on_spurious_congestion(&cc, &cstat, 120 * NGTCP2_MILLISECONDS);
+
+  CU_ASSERT(20 * 1200 == cstat.cwnd);
+
+  ngtcp2_cc_reno_cc_free(&cc, mem);
+}
+
+static void cwv_ack(ngtcp2_cc *cc, ngtcp2_conn_stat *cstat, int64_t pkt_num,
+                    uint64_t tx_in_flight, int is_app_limited,
+                    ngtcp2_tstamp ts) {
+  ngtcp2_cc_pkt pkt;
+  ngtcp2_cc_ack ack = {0};
+
+  cc->on_pkt_acked(cc, cstat,
+                   ngtcp2_cc_pkt_init(&pkt, pkt_num, 1200,
+                                      NGTCP2_PKTNS_ID_APPLICATION, ts, 0,
+                                      tx_in_flight, is_app_limited),
+                   ts);
+  cc->on_ack_recv(cc, cstat, &ack, ts);
+}
+
+static void check_cwnd_validation(cc_init ccinit, cc_free ccfree) {
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  ngtcp2_log log;
+  ngtcp2_cc cc;
+  ngtcp2_conn_stat cstat;
+  ngtcp2_tstamp t = 0;
+
+  ngtcp2_log_init(&log, NULL, NULL, NULL, 0, NULL);
+
+  hs_init_conn_stat(&cstat);
+  cstat.smoothed_rtt = 100 * NGTCP2_MILLISECONDS;
+  cstat.send_quantum = SIZE_MAX;
+  ccinit(&cc, &log, /* hystart = */ 0, /* cwnd_validation = */ 1, mem);
+
+  /* The app-limited sender uses less than the half of cwnd. */
+  cwv_ack(&cc, &cstat, 0, 1200, /* is_app_limited = */ 1, t);
+
+  CU_ASSERT(20 * 1200 == cstat.cwnd);
+  CU_ASSERT(0 == cstat.pacing_rate);
+  CU_ASSERT(SIZE_MAX == cstat.send_quantum);
+
+  /* cwnd grows if the packet was not sent while app-limited. */
+  t += 100 * NGTCP2_MILLISECONDS;
+  cwv_ack(&cc, &cstat, 1, 1200, /* is_app_limited = */ 0, t);
+
+  CU_ASSERT(21 * 1200 == cstat.cwnd);
+
+  /* The app-limited sender uses the whole cwnd. */
+  t += 100 * NGTCP2_MILLISECONDS;
+  cwv_ack(&cc, &cstat, 2, cstat.cwnd, /* is_app_limited = */ 1, t);
+
+  CU_ASSERT(22 * 1200 == cstat.cwnd);
+
+  /* The sender has been idle for more than 2 sampling periods.  The
+     restart burst is limited to the initial window. */
+  t += 3 * NGTCP2_SECONDS;
+  cc.event(&cc, &cstat, NGTCP2_CC_EVENT_TYPE_TX_START, t);
+
+  CU_ASSERT(ngtcp2_cc_compute_initcwnd(1200) == cstat.send_quantum);
+
+  cwv_ack(&cc, &cstat, 3, 1200, /* is_app_limited = */ 1, t);
+
+  CU_ASSERT(22 * 1200 == cstat.cwnd);
+  CU_ASSERT(0 == cstat.pacing_rate);
+  CU_ASSERT(ngtcp2_cc_compute_initcwnd(1200) == cstat.send_quantum);
+
+  /* The limit is lifted once cwnd is validated again. */
+  cwv_ack(&cc, &cstat, 4, cstat.cwnd, /* is_app_limited = */ 1, t);
+
+  CU_ASSERT(SIZE_MAX == cstat.send_quantum);
+
+  ccfree(&cc, mem);
+
+  /* Congestion window validation is disabled. */
+  hs_init_conn_stat(&cstat);
+  cstat.smoothed_rtt = 100 * NGTCP2_MILLISECONDS;
+  cstat.send_quantum = SIZE_MAX;
+  ccinit(&cc, &log, /* hystart = */ 0, /* cwnd_validation = */ 0, mem);
+
+  cwv_ack(&cc, &cstat, 0, 1200, /* is_app_limited = */ 1, t);
+
+  CU_ASSERT(21 * 1200 == cstat.cwnd);
+
+  t += 3 * NGTCP2_SECONDS;
+  cc.event(&cc, &cstat, NGTCP2_CC_EVENT_TYPE_TX_START, t);
+
+  CU_ASSERT(SIZE_MAX == cstat.send_quantum);
+
+  ccfree(&cc, mem);
+}
+
+void test_ngtcp2_cc_cwnd_validation(void) {
+  check_cwnd_validation(ngtcp2_cc_reno_cc_init, ngtcp2_cc_reno_cc_free);
+  check_cwnd_validation(ngtcp2_cc_cubic_cc_init, ngtcp2_cc_cubic_cc_free);
+}
@@ -29,6 +29,7 @@
 #include <CUnit/CUnit.h>
 
 #include "ngtcp2_conn.h"
+#include "ngtcp2_shared_pool.h"
 #include "ngtcp2_test_helper.h"
 #include "ngtcp2_mem.h"
 #include "ngtcp2_pkt.h"
@@ -69,6 +70,26 @@ static int null_encrypt(uint8_t *dest, const ngtcp2_crypto_aead *aead,
   return 0;
 }
 
+static size_t null_encrypt_batch_ncall;
+static size_t null_encrypt_batch_nop;
+
+static int null_encrypt_batch(const ngtcp2_crypto_aead *aead,
+                              const ngtcp2_crypto_aead_ctx *aead_ctx,
+                              const ngtcp2_encrypt_op *ops, size_t opslen) {
+  size_t i;
+
+  ++null_encrypt_batch_ncall;
+  null_encrypt_batch_nop += opslen;
+
+  for (i = 0; i < opslen; ++i) {
+    null_encrypt(ops[i].dest, aead, aead_ctx, ops[i].plaintext,
+                 ops[i].plaintextlen, ops[i].nonce, ops[i].noncelen,
+                 ops[i].aad, ops[i].aadlen);
+  }
+
+  return 0;
+}
+
 static int null_decrypt(uint8_t *dest, const ngtcp2_crypto_aead *aead,
                         const ngtcp2_crypto_aead_ctx *aead_ctx,
                         const uint8_t *ciphertext, size_t ciphertextlen,
@@ -114,6 +135,25 @@ static int null_hp_mask(uint8_t *dest, const ngtcp2_crypto_cipher *hp,
   return 0;
 }
 
+static size_t null_hp_mask_batch_ncall;
+static size_t null_hp_mask_batch_nsample;
+
+static int null_hp_mask_batch(uint8_t *dest, const ngtcp2_crypto_cipher *hp,
+                              const ngtcp2_crypto_cipher_ctx *hp_ctx,
+                              const uint8_t *const *samples,
+                              size_t nsamples) {
+  size_t i;
+
+  ++null_hp_mask_batch_ncall;
+  null_hp_mask_batch_nsample += nsamples;
+
+  for (i = 0; i < nsamples; ++i) {
+    null_hp_mask(dest + i * NGTCP2_HP_SAMPLELEN, hp, hp_ctx, samples[i]);
+  }
+
+  return 0;
+}
+
 static int get_new_connection_id(ngtcp2_conn *conn, ngtcp2_cid *cid,
                                  uint8_t *token, size_t cidlen,
                                  void *user_data) {
@@ -171,6 +211,7 @@ typedef struct {
   struct {
     int64_t stream_id;
     uint32_t flags;
+    const uint8_t *data;
     size_t datalen;
   } stream_data;
   struct {
@@ -178,14 +219,100 @@ typedef struct {
     const uint8_t *data;
     size_t datalen;
     uint64_t dgram_id;
+    size_t nlost;
   } datagram;
   struct {
     uint32_t flags;
     int64_t stream_id;
     uint64_t app_error_code;
   } stream_close;
+  struct {
+    size_t ncalls;
+    struct {
+      int64_t stream_id;
+      uint64_t offset;
+      uint64_t datalen;
+    } calls[4];
+  } acked_stream_data_offset;
+  struct {
+    size_t ncalls;
+    void *bufs[4];
+  } release_stream_buf;
+  struct {
+    size_t reset;
+    size_t on_pkt_sent;
+    size_t on_pkt_acked;
+    size_t new_rtt_sample;
+    size_t on_ack_recv;
+    uint64_t bytes_delivered;
+    int rs_present;
+  } user_cc;
+  struct {
+    size_t ncalls;
+    size_t n;
+  } get_new_connection_ids;
+  struct {
+    ngtcp2_relay *relay;
+    /* rxbuf is the buffer passed to ngtcp2_conn_read_pkt. */
+    void *rxbuf;
+    /* nref is the number of references to rxbuf that relay
+       holds. */
+    size_t nref;
+  } relay;
+  struct {
+    size_t ncalls;
+    uint64_t key_id;
+  } offload_tx_key;
 } my_user_data;
 
+static int offload_tx_key(ngtcp2_conn *conn, uint64_t key_id,
+                          const uint8_t *secret, size_t secretlen,
+                          void *user_data) {
+  my_user_data *ud = user_data;
+  (void)conn;
+  (void)secret;
+  (void)secretlen;
+
+  ++ud->offload_tx_key.ncalls;
+  ud->offload_tx_key.key_id = key_id;
+
+  return 0;
+}
+
+static int get_new_connection_ids(ngtcp2_conn *conn, ngtcp2_cid *cids,
+                                  uint8_t *tokens, size_t cidlen, size_t n,
+                                  void *user_data) {
+  my_user_data *ud = user_data;
+  size_t i;
+
+  if (ud) {
+    ++ud->get_new_connection_ids.ncalls;
+    ud->get_new_connection_ids.n = n;
+  }
+
+  for (i = 0; i < n; ++i) {
+    memset(cids[i].data, 0, cidlen);
+    cids[i].data[0] = (uint8_t)(conn->scid.last_seq + 1 + i);
+    cids[i].datalen = cidlen;
+  }
+
+  memset(tokens, 0, n * NGTCP2_STATELESS_RESET_TOKENLEN);
+
+  return 0;
+}
+
+static int fail_get_new_connection_ids(ngtcp2_conn *conn, ngtcp2_cid *cids,
+                                       uint8_t *tokens, size_t cidlen,
+                                       size_t n, void *user_data) {
+  (void)conn;
+  (void)cids;
+  (void)tokens;
+  (void)cidlen;
+  (void)n;
+  (void)user_data;
+  return NGTCP2_ERR_CALLBACK_FAILURE;
+}
+
 static int client_initial(ngtcp2_conn *conn, void *user_data) {
   (void)user_data;
 
@@ -409,12 +536,12 @@ static int recv_stream_data(ngtcp2_conn *conn, uint32_t flags,
   my_user_data *ud = user_data;
   (void)conn;
   (void)offset;
-  (void)data;
   (void)stream_user_data;
 
   if (ud) {
     ud->stream_data.stream_id = stream_id;
     ud->stream_data.flags = flags;
+    ud->stream_data.data = data;
     ud->stream_data.datalen = datalen;
   }
 
@@ -455,6 +582,90 @@ static int stream_close(ngtcp2_conn *conn, uint32_t flags, int64_t stream_id,
   return 0;
 }
 
+static int acked_stream_data_offset(ngtcp2_conn *conn, int64_t stream_id,
+                                    uint64_t offset, uint64_t datalen,
+                                    void *user_data, void *stream_user_data) {
+  my_user_data *ud = user_data;
+  size_t i;
+  (void)conn;
+  (void)stream_user_data;
+
+  if (ud) {
+    i = ud->acked_stream_data_offset.ncalls++;
+    if (i < sizeof(ud->acked_stream_data_offset.calls) /
+                sizeof(ud->acked_stream_data_offset.calls[0])) {
+      ud->acked_stream_data_offset.calls[i].stream_id = stream_id;
+      ud->acked_stream_data_offset.calls[i].offset = offset;
+      ud->acked_stream_data_offset.calls[i].datalen = datalen;
+    }
+  }
+
+  return 0;
+}
+
+static int recv_stream_data_relay(ngtcp2_conn *conn, uint32_t flags,
+                                  int64_t stream_id, uint64_t offset,
+                                  const uint8_t *data, size_t datalen,
+                                  void *user_data, void *stream_user_data) {
+  my_user_data *ud = user_data;
+  (void)conn;
+  (void)stream_id;
+  (void)stream_user_data;
+
+  if (ngtcp2_relay_recv_stream_data(ud->relay.relay, flags, offset, data,
+                                    datalen, ud->relay.rxbuf) != 0) {
+    return NGTCP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+
+static void release_stream_buf_relay(ngtcp2_conn *conn, int64_t stream_id,
+                                     void *buf_user_data, void *user_data,
+                                     void *stream_user_data) {
+  my_user_data *ud = user_data;
+  (void)conn;
+  (void)stream_id;
+  (void)stream_user_data;
+
+  ngtcp2_relay_release_stream_buf(ud->relay.relay, buf_user_data);
+}
+
+static void relay_ref_rxbuf(ngtcp2_relay *relay, void *rxbuf,
+                            void *user_data) {
+  my_user_data *ud = user_data;
+  (void)relay;
+
+  CU_ASSERT(ud->relay.rxbuf == rxbuf);
+
+  ++ud->relay.nref;
+}
+
+static void relay_unref_rxbuf(ngtcp2_relay *relay, void *rxbuf,
+                              void *user_data) {
+  my_user_data *ud = user_data;
+  (void)relay;
+  (void)rxbuf;
+
+  --ud->relay.nref;
+}
+
+static void release_stream_buf(ngtcp2_conn *conn, int64_t stream_id,
+                               void *buf_user_data, void *user_data,
+                               void *stream_user_data) {
+  my_user_data *ud = user_data;
+  size_t i;
+  (void)conn;
+  (void)stream_id;
+  (void)stream_user_data;
+
+  i = ud->release_stream_buf.ncalls++;
+  if (i < sizeof(ud->release_stream_buf.bufs) /
+              sizeof(ud->release_stream_buf.bufs[0])) {
+    ud->release_stream_buf.bufs[i] = buf_user_data;
+  }
+}
+
 static int recv_retry(ngtcp2_conn *conn, const ngtcp2_pkt_hd *hd,
                       void *user_data) {
   (void)conn;
@@ -496,6 +707,19 @@ static int ack_datagram(ngtcp2_conn *conn, uint64_t dgram_id, void *user_data) {
   return 0;
 }
 
+static int lost_datagram(ngtcp2_conn *conn, uint64_t dgram_id,
+                         void *user_data) {
+  my_user_data *ud = user_data;
+  (void)conn;
+
+  if (ud) {
+    ud->datagram.dgram_id = dgram_id;
+    ++ud->datagram.nlost;
+  }
+
+  return 0;
+}
+
 static int get_path_challenge_data(ngtcp2_conn *conn, uint8_t *data,
                                    void *user_data) {
   (void)conn;
@@ -653,9 +877,10 @@ static void conn_set_scid_used(ngtcp2_conn *conn) {
   assert(0 == rv);
 }
 
-static void setup_default_server(ngtcp2_conn **pconn) {
+static void setup_default_server_mem(ngtcp2_conn **pconn,
+                                     const ngtcp2_settings *settings,
+                                     const ngtcp2_mem *mem) {
   ngtcp2_callbacks cb;
-  ngtcp2_settings settings;
   ngtcp2_transport_params params;
   ngtcp2_cid dcid, scid;
   ngtcp2_transport_params remote_params;
@@ -669,12 +894,11 @@ static void setup_default_server(ngtcp2_conn **pconn) {
   init_crypto_ctx(&crypto_ctx);
 
   server_default_callbacks(&cb);
-  server_default_settings(&settings);
   server_default_transport_params(&params);
 
   ngtcp2_conn_server_new(pconn, &dcid, &scid, &null_path.path,
-                         NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
-                         /* mem = */ NULL, NULL);
+                         NGTCP2_PROTO_VER_V1, &cb, settings, &params, mem,
+                         NULL);
   ngtcp2_conn_set_crypto_ctx(*pconn, &crypto_ctx);
   ngtcp2_conn_install_rx_handshake_key(*pconn, &aead_ctx, null_iv,
                                        sizeof(null_iv), &hp_ctx);
@@ -700,14 +924,30 @@ static void setup_default_server(ngtcp2_conn **pconn) {
   remote_params.initial_max_data = 64 * 1024;
   remote_params.active_connection_id_limit = 8;
   remote_params.max_udp_payload_size = NGTCP2_DEFAULT_MAX_RECV_UDP_PAYLOAD_SIZE;
-  ngtcp2_transport_params_copy_new(&(*pconn)->remote.transport_params,
-                                   &remote_params, (*pconn)->mem);
+  ngtcp2_transport_params_storage_copy(
+      &(*pconn)->remote.transport_params_storage[0], &remote_params,
+      (*pconn)->mem);
+  (*pconn)->remote.transport_params =
+      &(*pconn)->remote.transport_params_storage[0].params;
   (*pconn)->local.bidi.max_streams = remote_params.initial_max_streams_bidi;
   (*pconn)->local.uni.max_streams = remote_params.initial_max_streams_uni;
   (*pconn)->tx.max_offset = remote_params.initial_max_data;
   (*pconn)->negotiated_version = (*pconn)->client_chosen_version;
 }
 
+static void setup_default_server_settings(ngtcp2_conn **pconn,
+                                          const ngtcp2_settings *settings) {
+  setup_default_server_mem(pconn, settings, /* mem = */ NULL);
+}
+
+static void setup_default_server(ngtcp2_conn **pconn) {
+  ngtcp2_settings settings;
+
+  server_default_settings(&settings);
+
+  setup_default_server_settings(pconn, &settings);
+}
+
 static void setup_default_client(ngtcp2_conn **pconn) {
   ngtcp2_callbacks cb;
   ngtcp2_settings settings;
@@ -755,8 +995,11 @@ static void setup_default_client(ngtcp2_conn **pconn) {
   remote_params.initial_max_data = 64 * 1024;
   remote_params.active_connection_id_limit = 8;
   remote_params.max_udp_payload_size = NGTCP2_DEFAULT_MAX_RECV_UDP_PAYLOAD_SIZE;
-  ngtcp2_transport_params_copy_new(&(*pconn)->remote.transport_params,
-                                   &remote_params, (*pconn)->mem);
+  ngtcp2_transport_params_storage_copy(
+      &(*pconn)->remote.transport_params_storage[0], &remote_params,
+      (*pconn)->mem);
+  (*pconn)->remote.transport_params =
+      &(*pconn)->remote.transport_params_storage[0].params;
   (*pconn)->local.bidi.max_streams = remote_params.initial_max_streams_bidi;
   (*pconn)->local.uni.max_streams = remote_params.initial_max_streams_uni;
   (*pconn)->tx.max_offset = remote_params.initial_max_data;
@@ -1023,7 +1266,7 @@ void test_ngtcp2_conn_stream_rx_flow_control(void) {
     CU_ASSERT(0 == rv);
   }
 
-  CU_ASSERT(3 == ngtcp2_pq_size(&conn->tx.strmq));
+  CU_ASSERT(3 == ngtcp2_cycleq_size(&conn->tx.strmcq));
 
   strm = ngtcp2_conn_find_stream(conn, 0);
 
@@ -1040,7 +1283,7 @@ void test_ngtcp2_conn_stream_rx_flow_control(void) {
   spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 2);
 
   CU_ASSERT(spktlen > 0);
-  CU_ASSERT(ngtcp2_pq_empty(&conn->tx.strmq));
+  CU_ASSERT(ngtcp2_conn_tx_strmq_empty(conn));
 
   for (i = 0; i < 3; ++i) {
     stream_id = (int64_t)(i * 4);
@@ -1236,865 +1479,914 @@ void test_ngtcp2_conn_rx_flow_control(void) {
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_rx_flow_control_error(void) {
+void test_ngtcp2_conn_mem_budget(void) {
   ngtcp2_conn *conn;
   uint8_t buf[2048];
   size_t pktlen;
   int rv;
   ngtcp2_frame fr;
+  ngtcp2_mem_stat mstat;
+  ngtcp2_settings settings;
+  ngtcp2_vec datav = {null_data, 10};
 
+  /* The memory is not counted without a budget. */
   setup_default_server(&conn);
 
+  ngtcp2_conn_get_mem_stat(conn, &mstat);
+
+  CU_ASSERT(0 == mstat.total);
+  CU_ASSERT(0 == mstat.peak);
+
+  ngtcp2_conn_del(conn);
+
+  server_default_settings(&settings);
+  settings.mem_budget = UINT64_MAX;
+
+  setup_default_server_settings(&conn, &settings);
+
+  ngtcp2_conn_get_mem_stat(conn, &mstat);
+
+  CU_ASSERT(mstat.total > 0);
+  CU_ASSERT(mstat.ksl > 0);
+  CU_ASSERT(0 == mstat.rob);
+  CU_ASSERT(0 == mstat.dgram);
+  CU_ASSERT(mstat.total == mstat.ksl + mstat.rob + mstat.balloc +
+                               mstat.crypto + mstat.dgram + mstat.other);
+  CU_ASSERT(mstat.peak >= mstat.total);
+
   conn->local.transport_params.initial_max_data = 1024;
   conn->rx.window = 1024;
   conn->rx.max_offset = 1024;
   conn->rx.unsent_max_offset = 1024;
 
+  /* Out of order data is buffered in rob. */
   fr.type = NGTCP2_FRAME_STREAM;
   fr.stream.flags = 0;
   fr.stream.stream_id = 4;
   fr.stream.fin = 0;
-  fr.stream.offset = 0;
+  fr.stream.offset = 1;
   fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 1025;
+  fr.stream.data[0].len = 1022;
   fr.stream.data[0].base = null_data;
 
   pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
                                   conn->pktns.crypto.rx.ckm);
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  CU_ASSERT(NGTCP2_ERR_FLOW_CONTROL == rv);
-
-  ngtcp2_conn_del(conn);
-}
+  CU_ASSERT(0 == rv);
 
-void test_ngtcp2_conn_tx_flow_control(void) {
-  ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  size_t pktlen;
-  ngtcp2_ssize spktlen;
-  int rv;
-  ngtcp2_frame fr;
-  ngtcp2_ssize nwrite;
-  int64_t stream_id;
+  ngtcp2_conn_get_mem_stat(conn, &mstat);
 
-  setup_default_client(&conn);
+  CU_ASSERT(mstat.rob > 0);
 
-  conn->remote.transport_params->initial_max_data = 2048;
-  conn->tx.max_offset = 2048;
+  fr.stream.offset = 0;
+  fr.stream.data[0].len = 1;
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
 
   CU_ASSERT(0 == rv);
 
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
-                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
-                                     stream_id, null_data, 1024, 1);
-
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(1024 == nwrite);
-  CU_ASSERT(1024 == conn->tx.offset);
+  ngtcp2_conn_extend_max_offset(conn, 1023);
 
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
-                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
-                                     stream_id, null_data, 1023, 2);
+  CU_ASSERT(1024 + 1023 == conn->rx.unsent_max_offset);
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(1023 == nwrite);
-  CU_ASSERT(1024 + 1023 == conn->tx.offset);
+  /* MAX_DATA is withheld while the budget is exceeded. */
+  ngtcp2_conn_get_mem_stat(conn, &mstat);
+  conn->local.settings.mem_budget = mstat.total;
 
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
-                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
-                                     stream_id, null_data, 1024, 3);
+  ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 3);
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(1 == nwrite);
-  CU_ASSERT(2048 == conn->tx.offset);
+  CU_ASSERT(1024 == conn->rx.max_offset);
 
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
-                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
-                                     stream_id, null_data, 1024, 4);
+  conn->local.settings.mem_budget = UINT64_MAX;
 
-  CU_ASSERT(spktlen == 0);
-  CU_ASSERT(-1 == nwrite);
+  ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 4);
 
-  fr.type = NGTCP2_FRAME_MAX_DATA;
-  fr.max_data.max_data = 3072;
+  CU_ASSERT(1024 + 1023 == conn->rx.max_offset);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
-                                  conn->pktns.crypto.rx.ckm);
+  /* Queued DATAGRAMs are counted in dgram. */
+  conn->remote.transport_params->max_datagram_frame_size = 65535;
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 5);
+  rv = ngtcp2_conn_enqueue_datagram(conn, 1, &datav, 1, UINT64_MAX);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(3072 == conn->tx.max_offset);
 
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
-                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
-                                     stream_id, null_data, 1024, 4);
+  ngtcp2_conn_get_mem_stat(conn, &mstat);
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(1024 == nwrite);
-  CU_ASSERT(3072 == conn->tx.offset);
+  CU_ASSERT(mstat.dgram > 0);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_shutdown_stream_write(void) {
+void test_ngtcp2_conn_hibernate(void) {
   ngtcp2_conn *conn;
-  int rv;
-  ngtcp2_frame_chain *frc;
   uint8_t buf[2048];
-  ngtcp2_frame fr;
   size_t pktlen;
-  ngtcp2_ssize spktlen;
+  int rv;
+  ngtcp2_frame fr;
+  ngtcp2_mem_stat mstat;
+  uint64_t balloc;
   ngtcp2_strm *strm;
-  int64_t stream_id;
+  ngtcp2_settings settings;
 
-  /* Stream not found */
-  setup_default_server(&conn);
+  server_default_settings(&settings);
+  settings.mem_budget = UINT64_MAX;
 
-  rv = ngtcp2_conn_shutdown_stream_write(conn, 4, NGTCP2_APP_ERR01);
+  setup_default_server_settings(&conn, &settings);
+
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.flags = 0;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 111;
+  fr.stream.data[0].base = null_data;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
   CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != conn->crypto.decrypt_buf.base);
 
-  ngtcp2_conn_del(conn);
+  strm = ngtcp2_conn_find_stream(conn, 4);
 
-  /* Check final_size */
-  setup_default_client(&conn);
+  CU_ASSERT(NULL != strm);
 
-  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
-  ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                           NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id, null_data,
-                           1239, 1);
-  rv = ngtcp2_conn_shutdown_stream_write(conn, stream_id, NGTCP2_APP_ERR01);
+  /* The pool of an open stream is kept. */
+  ngtcp2_conn_hibernate(conn);
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL == conn->crypto.decrypt_buf.base);
+  CU_ASSERT(0 == conn->crypto.decrypt_buf.len);
+#ifndef NOMEMPOOL
+  CU_ASSERT(NULL != conn->strm_objalloc->balloc.head);
+#endif /* NOMEMPOOL */
 
-  for (frc = conn->pktns.tx.frq; frc; frc = frc->next) {
-    if (frc->fr.type == NGTCP2_FRAME_RESET_STREAM) {
-      break;
-    }
-  }
+  ngtcp2_conn_get_mem_stat(conn, &mstat);
+  balloc = mstat.balloc;
 
-  CU_ASSERT(NULL != frc);
-  CU_ASSERT(stream_id == frc->fr.reset_stream.stream_id);
-  CU_ASSERT(NGTCP2_APP_ERR01 == frc->fr.reset_stream.app_error_code);
-  CU_ASSERT(1239 == frc->fr.reset_stream.final_size);
+  rv = ngtcp2_conn_close_stream(conn, strm);
 
-  strm = ngtcp2_conn_find_stream(conn, stream_id);
+  CU_ASSERT(0 == rv);
 
-  CU_ASSERT(NULL != strm);
-  CU_ASSERT(NGTCP2_APP_ERR01 == strm->app_error_code);
+  ngtcp2_conn_hibernate(conn);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 2);
+  CU_ASSERT(NULL == conn->strm_objalloc->balloc.head);
 
-  CU_ASSERT(spktlen > 0);
+  ngtcp2_conn_get_mem_stat(conn, &mstat);
 
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = stream_id;
-  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
-  fr.reset_stream.final_size = 100;
+#ifndef NOMEMPOOL
+  CU_ASSERT(mstat.balloc < balloc);
+#else /* NOMEMPOOL */
+  (void)balloc;
+#endif /* NOMEMPOOL */
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 890, &fr,
-                                  conn->pktns.crypto.rx.ckm);
+  /* conn allocates the memory again on demand. */
+  fr.stream.stream_id = 8;
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
-
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, stream_id));
-
-  fr.type = NGTCP2_FRAME_ACK;
-  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
-  fr.ack.ack_delay = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
-
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 899, &fr,
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
                                   conn->pktns.crypto.rx.ckm);
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL == ngtcp2_conn_find_stream(conn, stream_id));
+  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 8));
+#ifndef NOMEMPOOL
+  CU_ASSERT(NULL != conn->strm_objalloc->balloc.head);
+#endif /* NOMEMPOOL */
 
   ngtcp2_conn_del(conn);
+}
 
-  /* Check that stream is closed when RESET_STREAM is acknowledged */
-  setup_default_client(&conn);
-
-  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+void test_ngtcp2_conn_shared_pool(void) {
+  ngtcp2_shared_pool *pool;
+  ngtcp2_shared_pool_stat stat;
+  ngtcp2_settings settings;
+  ngtcp2_conn *conn[2];
+  uint8_t buf[2048];
+  size_t pktlen;
+  int rv;
+  ngtcp2_frame fr;
+  size_t i;
 
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = stream_id;
-  fr.stream.fin = 0;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 0;
+  rv = ngtcp2_shared_pool_new(&pool, 0, NULL);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 119, &fr,
-                                  conn->pktns.crypto.rx.ckm);
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+  rv = ngtcp2_shared_pool_new(&pool, 1, NULL);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, stream_id));
 
-  rv = ngtcp2_conn_shutdown_stream_write(conn, stream_id, NGTCP2_APP_ERR01);
+  server_default_settings(&settings);
+  settings.shared_pool = pool;
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, stream_id));
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.flags = 0;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 111;
+  fr.stream.data[0].base = null_data;
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 2);
+  for (i = 0; i < arraylen(conn); ++i) {
+    setup_default_server_settings(&conn[i], &settings);
 
-  CU_ASSERT(spktlen > 0);
+    pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn[i]->oscid, 1, &fr,
+                                    conn[i]->pktns.crypto.rx.ckm);
+    rv = ngtcp2_conn_read_pkt(conn[i], &null_path.path, &null_pi, buf, pktlen,
+                              1);
 
-  /* Incoming FIN does not close stream */
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.fin = 1;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 0;
+    CU_ASSERT(0 == rv);
+    CU_ASSERT(&pool->strm == conn[i]->strm_objalloc);
+  }
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 121, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
+  CU_ASSERT(2 == pool->strm.nused);
+  CU_ASSERT(2 == pool->strm.nallocated);
+  CU_ASSERT(0 == conn[0]->objalloc.strm.nused);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, stream_id));
+  /* The stream released by a connection is reused by another. */
+  ngtcp2_conn_del(conn[0]);
 
-  fr.type = NGTCP2_FRAME_ACK;
-  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
-  fr.ack.ack_delay = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
+  CU_ASSERT(1 == pool->strm.nused);
+  CU_ASSERT(1 == pool->strm.ncached);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 332, &fr,
-                                  conn->pktns.crypto.rx.ckm);
+  fr.stream.stream_id = 8;
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 3);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn[1]->oscid, 2, &fr,
+                                  conn[1]->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn[1], &null_path.path, &null_pi, buf, pktlen, 2);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL == ngtcp2_conn_find_stream(conn, stream_id));
+  CU_ASSERT(2 == pool->strm.nused);
+  CU_ASSERT(0 == pool->strm.ncached);
+  CU_ASSERT(1 == pool->strm.nreused);
+  CU_ASSERT(2 == pool->strm.nallocated);
 
-  ngtcp2_conn_del(conn);
+  /* The pool keeps at most max_cached objects. */
+  ngtcp2_conn_del(conn[1]);
 
-  /* RESET_STREAM is not sent if all tx data are acknowledged */
-  setup_default_client(&conn);
+  CU_ASSERT(0 == pool->strm.nused);
+  CU_ASSERT(1 == pool->strm.ncached);
 
-  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  ngtcp2_shared_pool_get_stat(pool, &stat);
 
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                                     NGTCP2_WRITE_STREAM_FLAG_FIN, stream_id,
-                                     null_data, 0, 3);
+  CU_ASSERT(0 == stat.in_use);
+  CU_ASSERT(stat.cached >= 1);
+  CU_ASSERT(stat.reused >= 1);
+  CU_ASSERT(stat.allocated >= 2);
 
-  CU_ASSERT(spktlen > 0);
+  ngtcp2_shared_pool_trim(pool);
+  ngtcp2_shared_pool_get_stat(pool, &stat);
 
-  fr.type = NGTCP2_FRAME_ACK;
-  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
-  fr.ack.ack_delay = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
+  CU_ASSERT(0 == stat.cached);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 999, &fr,
-                                  conn->pktns.crypto.rx.ckm);
+  ngtcp2_shared_pool_del(pool);
+}
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 7);
+void test_ngtcp2_conn_free_handshake_only_state(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_frame fr;
+  int rv;
 
-  CU_ASSERT(0 == rv);
+  setup_default_client(&conn);
 
-  rv = ngtcp2_conn_shutdown_stream_write(conn, stream_id, NGTCP2_APP_ERR01);
+  /* Pretend that the handshake has not been confirmed yet, and the
+     handshake-only state is still there. */
+  conn->flags &= (uint32_t)~NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED;
 
-  CU_ASSERT(0 == rv);
+  conn->local.settings.token.base = ngtcp2_mem_malloc(conn->mem, 32);
+  conn->local.settings.token.len = 32;
+  conn->vneg.preferred_versions =
+      ngtcp2_mem_malloc(conn->mem, sizeof(uint32_t));
+  conn->vneg.preferred_versions[0] = NGTCP2_PROTO_VER_V1;
+  conn->vneg.preferred_versionslen = 1;
 
-  strm = ngtcp2_conn_find_stream(conn, stream_id);
+  CU_ASSERT(NULL != conn->hs_pktns);
 
-  CU_ASSERT(!(strm->flags & NGTCP2_STRM_FLAG_SENT_RST));
+  fr.type = NGTCP2_FRAME_HANDSHAKE_DONE;
 
-  spktlen =
-      ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                               NGTCP2_WRITE_STREAM_FLAG_FIN, -1, NULL, 0, 11);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  CU_ASSERT(0 == spktlen);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(conn->flags & NGTCP2_CONN_FLAG_HANDSHAKE_CONFIRMED);
+  CU_ASSERT(NULL == conn->hs_pktns);
+  CU_ASSERT(NULL == conn->local.settings.token.base);
+  CU_ASSERT(0 == conn->local.settings.token.len);
+  CU_ASSERT(NULL == conn->vneg.preferred_versions);
+  CU_ASSERT(0 == conn->vneg.preferred_versionslen);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_recv_reset_stream(void) {
+void test_ngtcp2_conn_snapshot(void) {
   ngtcp2_conn *conn;
-  int rv;
-  uint8_t buf[2048];
-  ngtcp2_frame fr;
+  ngtcp2_callbacks cb;
+  ngtcp2_settings settings;
+  ngtcp2_transport_params params;
+  ngtcp2_cid dcid, scid;
+  ngtcp2_crypto_aead_ctx aead_ctx = {0};
+  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
+  ngtcp2_crypto_ctx crypto_ctx;
+  ngtcp2_vec rx_secret, tx_secret;
+  uint8_t buf[2048], snapshot[1024];
+  ngtcp2_ssize nwrite, spktlen;
   size_t pktlen;
-  ngtcp2_ssize spktlen;
+  ngtcp2_frame fr;
   ngtcp2_strm *strm;
-  int64_t stream_id;
+  my_user_data ud;
+  int64_t pkt_num = 0, last_pkt_num, stream_id;
+  ngtcp2_tstamp t = 0;
+  int rv;
 
-  /* Receive RESET_STREAM */
   setup_default_server(&conn);
 
   fr.type = NGTCP2_FRAME_STREAM;
   fr.stream.flags = 0;
-  fr.stream.stream_id = 4;
+  fr.stream.stream_id = 0;
   fr.stream.fin = 0;
   fr.stream.offset = 0;
   fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 955;
+  fr.stream.data[0].len = 111;
   fr.stream.data[0].base = null_data;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, &fr, 1,
+                     conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
 
-  ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                           NGTCP2_WRITE_STREAM_FLAG_NONE, 4, null_data, 354, 2);
-
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = 4;
-  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
-  fr.reset_stream.final_size = 955;
+  nwrite = ngtcp2_conn_encode_snapshot(conn, snapshot, 16);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 3);
+  CU_ASSERT(NGTCP2_ERR_NOBUF == nwrite);
 
-  CU_ASSERT(0 == rv);
+  nwrite = ngtcp2_conn_encode_snapshot(conn, snapshot, sizeof(snapshot));
 
-  strm = ngtcp2_conn_find_stream(conn, 4);
+  CU_ASSERT(nwrite > 0);
 
-  CU_ASSERT(strm->flags & NGTCP2_STRM_FLAG_SHUT_RD);
-  CU_ASSERT(strm->flags & NGTCP2_STRM_FLAG_RECV_RST);
+  last_pkt_num = conn->pktns.tx.last_pkt_num;
 
   ngtcp2_conn_del(conn);
 
-  /* Receive RESET_STREAM after sending STOP_SENDING */
-  setup_default_server(&conn);
-
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.flags = 0;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 0;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 955;
-  fr.stream.data[0].base = null_data;
+  /* Another process takes the connection over. */
+  memset(&ud, 0, sizeof(ud));
+  dcid_init(&dcid);
+  scid_init(&scid);
+  init_crypto_ctx(&crypto_ctx);
+  server_default_callbacks(&cb);
+  server_default_settings(&settings);
+  server_default_transport_params(&params);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+  cb.recv_stream_data = recv_stream_data;
 
-  CU_ASSERT(0 == rv);
+  ngtcp2_conn_server_new(&conn, &dcid, &scid, &null_path.path,
+                         NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
+                         /* mem = */ NULL, &ud);
+  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
 
-  ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                           NGTCP2_WRITE_STREAM_FLAG_NONE, 4, null_data, 354, 2);
-  ngtcp2_conn_shutdown_stream_read(conn, 4, NGTCP2_APP_ERR01);
-  ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 3);
+  rv = ngtcp2_conn_decode_and_set_snapshot(conn, &rx_secret, &tx_secret,
+                                           snapshot, (size_t)nwrite - 1, t);
 
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = 4;
-  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
-  fr.reset_stream.final_size = 955;
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 4);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 4));
+  ngtcp2_conn_server_new(&conn, &dcid, &scid, &null_path.path,
+                         NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
+                         /* mem = */ NULL, &ud);
+  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
 
-  ngtcp2_conn_del(conn);
+  rv = ngtcp2_conn_decode_and_set_snapshot(conn, &rx_secret, &tx_secret,
+                                           snapshot, (size_t)nwrite, t);
 
-  /* Receive RESET_STREAM after sending RESET_STREAM */
-  setup_default_server(&conn);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_CS_POST_HANDSHAKE == conn->state);
+  CU_ASSERT(NULL == conn->in_pktns);
+  CU_ASSERT(NULL == conn->hs_pktns);
+  CU_ASSERT(sizeof(null_secret) == rx_secret.len);
+  CU_ASSERT(0 == memcmp(null_secret, rx_secret.base, rx_secret.len));
+  CU_ASSERT(sizeof(null_secret) == tx_secret.len);
+  CU_ASSERT(pkt_num == conn->pktns.rx.max_pkt_num);
+  CU_ASSERT(last_pkt_num == conn->pktns.tx.last_pkt_num);
+  CU_ASSERT(111 == conn->rx.offset);
 
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.flags = 0;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 0;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 955;
-  fr.stream.data[0].base = null_data;
+  strm = ngtcp2_conn_find_stream(conn, 0);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+  CU_ASSERT(NULL != strm);
+  CU_ASSERT(111 == ngtcp2_strm_rx_offset(strm));
 
-  CU_ASSERT(0 == rv);
+  rv = ngtcp2_conn_decode_and_set_snapshot(conn, &rx_secret, &tx_secret,
+                                           snapshot, (size_t)nwrite, t);
 
-  ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                           NGTCP2_WRITE_STREAM_FLAG_NONE, 4, null_data, 354, 2);
-  ngtcp2_conn_shutdown_stream_write(conn, 4, NGTCP2_APP_ERR01);
-  ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 3);
+  CU_ASSERT(NGTCP2_ERR_INVALID_STATE == rv);
 
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = 4;
-  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
-  fr.reset_stream.final_size = 955;
+  ngtcp2_conn_install_rx_key(conn, rx_secret.base, rx_secret.len, &aead_ctx,
+                             null_iv, sizeof(null_iv), &hp_ctx);
+  ngtcp2_conn_install_tx_key(conn, tx_secret.base, tx_secret.len, &aead_ctx,
+                             null_iv, sizeof(null_iv), &hp_ctx);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 4);
+  /* The packet received before the snapshot is a duplicate. */
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 4));
+  CU_ASSERT(0 == ud.stream_data.datalen);
 
-  fr.type = NGTCP2_FRAME_ACK;
-  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
-  fr.ack.ack_delay = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
+  fr.stream.offset = 111;
+  fr.stream.data[0].len = 99;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 3, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 5);
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, &fr, 1,
+                     conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL == ngtcp2_conn_find_stream(conn, 4));
+  CU_ASSERT(0 == ud.stream_data.stream_id);
+  CU_ASSERT(99 == ud.stream_data.datalen);
+  CU_ASSERT(210 == ngtcp2_strm_rx_offset(strm));
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(last_pkt_num + 1 == conn->pktns.tx.last_pkt_num);
 
   ngtcp2_conn_del(conn);
 
-  /* Receive RESET_STREAM after receiving STOP_SENDING */
+  /* The snapshot is not taken while the sent data is in flight. */
   setup_default_server(&conn);
 
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.flags = 0;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 0;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 955;
-  fr.stream.data[0].base = null_data;
-
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+  rv = ngtcp2_conn_open_uni_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
 
-  ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                           NGTCP2_WRITE_STREAM_FLAG_NONE, 4, null_data, 354, 2);
-
-  fr.type = NGTCP2_FRAME_STOP_SENDING;
-  fr.stop_sending.stream_id = 4;
-  fr.stop_sending.app_error_code = NGTCP2_APP_ERR01;
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 10, ++t);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 3);
+  CU_ASSERT(spktlen > 0);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 4));
+  nwrite = ngtcp2_conn_encode_snapshot(conn, snapshot, sizeof(snapshot));
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 4);
+  CU_ASSERT(NGTCP2_ERR_INVALID_STATE == nwrite);
 
-  CU_ASSERT(spktlen > 0);
+  ngtcp2_conn_del(conn);
+}
 
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = 4;
-  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
-  fr.reset_stream.final_size = 955;
+/*
+ * restore_server creates a server connection, and restores the
+ * snapshot pointed by |snapshot| of length |snapshotlen| with
+ * |crypto_ctx| into it.  The 1RTT keys are installed if it succeeds.
+ */
+static int restore_server(ngtcp2_conn **pconn, const uint8_t *snapshot,
+                          size_t snapshotlen,
+                          const ngtcp2_crypto_ctx *crypto_ctx,
+                          ngtcp2_tstamp ts) {
+  ngtcp2_callbacks cb;
+  ngtcp2_settings settings;
+  ngtcp2_transport_params params;
+  ngtcp2_cid dcid, scid;
+  ngtcp2_crypto_aead_ctx aead_ctx = {0};
+  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
+  ngtcp2_vec rx_secret, tx_secret;
+  int rv;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 3, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 4);
+  dcid_init(&dcid);
+  scid_init(&scid);
+  server_default_callbacks(&cb);
+  server_default_settings(&settings);
+  server_default_transport_params(&params);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 4));
+  ngtcp2_conn_server_new(pconn, &dcid, &scid, &null_path.path,
+                         NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
+                         /* mem = */ NULL, NULL);
+  ngtcp2_conn_set_crypto_ctx(*pconn, crypto_ctx);
 
-  fr.type = NGTCP2_FRAME_ACK;
-  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
-  fr.ack.ack_delay = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
+  rv = ngtcp2_conn_decode_and_set_snapshot(*pconn, &rx_secret, &tx_secret,
+                                           snapshot, snapshotlen, ts);
+  if (rv != 0) {
+    return rv;
+  }
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 4, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 5);
+  ngtcp2_conn_install_rx_key(*pconn, rx_secret.base, rx_secret.len,
+                             &aead_ctx, null_iv, sizeof(null_iv), &hp_ctx);
+  ngtcp2_conn_install_tx_key(*pconn, tx_secret.base, tx_secret.len,
+                             &aead_ctx, null_iv, sizeof(null_iv), &hp_ctx);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL == ngtcp2_conn_find_stream(conn, 4));
+  return 0;
+}
 
-  ngtcp2_conn_del(conn);
+void test_ngtcp2_conn_snapshot_aead_limit(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_crypto_ctx crypto_ctx;
+  uint8_t buf[2048], snapshot[2][1024];
+  ngtcp2_ssize nwrite[2], spktlen;
+  size_t pktlen;
+  ngtcp2_frame fr;
+  ngtcp2_tstamp t = 0;
+  int rv;
 
-  /* final_size in RESET_STREAM exceeds the already received offset */
   setup_default_server(&conn);
 
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.flags = 0;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 0;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 955;
-  fr.stream.data[0].base = null_data;
+  /* The confidentiality limit has been reached. */
+  conn->pktns.crypto.tx.ckm->use_count = conn->pktns.crypto.ctx.max_encryption;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+  nwrite[0] =
+      ngtcp2_conn_encode_snapshot(conn, snapshot[0], sizeof(snapshot[0]));
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(nwrite[0] > 0);
 
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = 4;
-  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
-  fr.reset_stream.final_size = 954;
+  /* The next decryption failure reaches the integrity limit. */
+  conn->pktns.crypto.tx.ckm->use_count = 0;
+  conn->crypto.decryption_failure_count =
+      conn->pktns.crypto.ctx.max_decryption_failure - 1;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
+  nwrite[1] =
+      ngtcp2_conn_encode_snapshot(conn, snapshot[1], sizeof(snapshot[1]));
 
-  CU_ASSERT(NGTCP2_ERR_FINAL_SIZE == rv);
+  CU_ASSERT(nwrite[1] > 0);
 
   ngtcp2_conn_del(conn);
 
-  /* final_size in RESET_STREAM differs from the final offset which
-     STREAM frame with fin indicated. */
-  setup_default_server(&conn);
-
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.flags = 0;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 1;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 955;
-  fr.stream.data[0].base = null_data;
+  /* The crypto context of the other cipher suite is rejected. */
+  init_crypto_ctx(&crypto_ctx);
+  ++crypto_ctx.max_encryption;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+  rv = restore_server(&conn, snapshot[0], (size_t)nwrite[0], &crypto_ctx, t);
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
 
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = 4;
-  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
-  fr.reset_stream.final_size = 956;
+  ngtcp2_conn_del(conn);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
+  init_crypto_ctx(&crypto_ctx);
 
-  CU_ASSERT(NGTCP2_ERR_FINAL_SIZE == rv);
+  rv = restore_server(&conn, snapshot[0], (size_t)nwrite[0], &crypto_ctx, t);
 
-  ngtcp2_conn_del(conn);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(crypto_ctx.max_encryption ==
+            conn->pktns.crypto.tx.ckm->use_count);
 
-  /* RESET_STREAM against local stream which has not been initiated. */
-  setup_default_server(&conn);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = 1;
-  fr.reset_stream.app_error_code = NGTCP2_APP_ERR01;
-  fr.reset_stream.final_size = 0;
+  CU_ASSERT(NGTCP2_ERR_AEAD_LIMIT_REACHED == spktlen);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(NGTCP2_ERR_STREAM_STATE == rv);
+  rv = restore_server(&conn, snapshot[1], (size_t)nwrite[1], &crypto_ctx, t);
 
-  ngtcp2_conn_del(conn);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(crypto_ctx.max_decryption_failure - 1 ==
+            conn->crypto.decryption_failure_count);
 
-  /* RESET_STREAM against remote stream which has not been initiated */
-  setup_default_server(&conn);
+  conn->callbacks.decrypt = fail_decrypt;
 
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = 0;
-  fr.reset_stream.app_error_code = NGTCP2_APP_ERR01;
-  fr.reset_stream.final_size = 1999;
+  fr.type = NGTCP2_FRAME_PING;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1000000,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL == ngtcp2_conn_find_stream(conn, 0));
-  CU_ASSERT(4 == conn->remote.bidi.unsent_max_streams);
+  CU_ASSERT(NGTCP2_ERR_AEAD_LIMIT_REACHED == rv);
 
   ngtcp2_conn_del(conn);
+}
 
-  /* RESET_STREAM against remote stream which is larger than allowed
-     maximum */
-  setup_default_server(&conn);
+void test_ngtcp2_conn_published_conn_stat(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_settings settings;
+  ngtcp2_conn_stat cstat;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_frame fr;
+  int rv;
 
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = 16;
-  fr.reset_stream.app_error_code = NGTCP2_APP_ERR01;
-  fr.reset_stream.final_size = 0;
+  /* Not enabled */
+  setup_default_server(&conn);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+  rv = ngtcp2_conn_get_published_conn_stat(conn, &cstat);
 
-  CU_ASSERT(NGTCP2_ERR_STREAM_LIMIT == rv);
+  CU_ASSERT(NGTCP2_ERR_INVALID_STATE == rv);
 
   ngtcp2_conn_del(conn);
 
-  /* RESET_STREAM against remote stream which is allowed, and no
-     ngtcp2_strm object has been created */
-  setup_default_server(&conn);
+  /* Enabled */
+  server_default_settings(&settings);
+  settings.publish_conn_stat = 1;
 
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = 4;
-  fr.reset_stream.app_error_code = NGTCP2_APP_ERR01;
-  fr.reset_stream.final_size = 0;
+  setup_default_server_settings(&conn, &settings);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+  rv = ngtcp2_conn_get_published_conn_stat(conn, &cstat);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(
-      ngtcp2_idtr_is_open(&conn->remote.bidi.idtr, fr.reset_stream.stream_id));
-
-  ngtcp2_conn_del(conn);
-
-  /* RESET_STREAM against remote stream which is allowed, and no
-     ngtcp2_strm object has been created, and final_size violates
-     connection-level flow control. */
-  setup_default_server(&conn);
-
-  conn->local.transport_params.initial_max_stream_data_bidi_remote = 1 << 21;
+  CU_ASSERT(conn->cstat.smoothed_rtt == cstat.smoothed_rtt);
+  CU_ASSERT(conn->cstat.cwnd == cstat.cwnd);
 
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = 4;
-  fr.reset_stream.app_error_code = NGTCP2_APP_ERR01;
-  fr.reset_stream.final_size = 1 << 20;
+  fr.type = NGTCP2_FRAME_PING;
 
   pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
                                   conn->pktns.crypto.rx.ckm);
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  CU_ASSERT(NGTCP2_ERR_FLOW_CONTROL == rv);
+  CU_ASSERT(0 == rv);
 
-  ngtcp2_conn_del(conn);
+  rv = ngtcp2_conn_get_published_conn_stat(conn, &cstat);
 
-  /* RESET_STREAM against remote stream which is allowed, and no
-      ngtcp2_strm object has been created, and final_size violates
-      stream-level flow control. */
-  setup_default_server(&conn);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(conn->cstat.bytes_in_flight == cstat.bytes_in_flight);
+  CU_ASSERT(conn->cstat.loss_detection_timer == cstat.loss_detection_timer);
 
-  conn->rx.max_offset = 1 << 21;
+  rv = (int)ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 2);
 
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = 4;
-  fr.reset_stream.app_error_code = NGTCP2_APP_ERR01;
-  fr.reset_stream.final_size = 1 << 20;
+  CU_ASSERT(rv > 0);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+  rv = ngtcp2_conn_get_published_conn_stat(conn, &cstat);
 
-  CU_ASSERT(NGTCP2_ERR_FLOW_CONTROL == rv);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(2 == cstat.last_tx_pkt_ts[NGTCP2_PKTNS_ID_APPLICATION]);
+  CU_ASSERT(conn->cstat.bytes_in_flight == cstat.bytes_in_flight);
 
   ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_flow_window_autotuning(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
 
-  /* final_size in RESET_STREAM violates connection-level flow
-     control */
   setup_default_server(&conn);
 
-  conn->local.transport_params.initial_max_stream_data_bidi_remote = 1 << 21;
+  conn->local.settings.max_window = 1000000;
+  conn->local.transport_params.initial_max_data = 1024;
+  conn->rx.window = 1024;
+  conn->rx.max_offset = 1024;
+  conn->rx.unsent_max_offset = 1024;
+  conn->tx.last_max_data_ts = 0;
+  conn->cstat.smoothed_rtt = 100 * NGTCP2_MILLISECONDS;
 
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.flags = 0;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 0;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 955;
-  fr.stream.data[0].base = null_data;
+  /* 1024 bytes consumed in 10ms over 100ms RTT: BDP is 10240 bytes,
+     which is larger than doubling the window. */
+  ngtcp2_conn_extend_max_offset(conn, 1024);
+  ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf),
+                        10 * NGTCP2_MILLISECONDS);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+  CU_ASSERT(2 * 10240 == conn->rx.window);
+  CU_ASSERT(2048 + 2 * 10240 - 1024 == conn->rx.max_offset);
 
-  CU_ASSERT(0 == rv);
+  /* Slow consumer: the window is not grown. */
+  ngtcp2_conn_extend_max_offset(conn, 2 * 10240);
+  ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf),
+                        1000 * NGTCP2_MILLISECONDS);
 
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = 4;
-  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
-  fr.reset_stream.final_size = 1024 * 1024;
+  CU_ASSERT(2 * 10240 == conn->rx.window);
+  CU_ASSERT(2048 + 4 * 10240 - 1024 == conn->rx.max_offset);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
+  /* Very fast consumer: the window is capped by max_window. */
+  ngtcp2_conn_extend_max_offset(conn, 2 * 10240);
+  ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf),
+                        1001 * NGTCP2_MILLISECONDS);
 
-  CU_ASSERT(NGTCP2_ERR_FLOW_CONTROL == rv);
+  CU_ASSERT(1000000 == conn->rx.window);
 
   ngtcp2_conn_del(conn);
+}
 
-  /* final_size in RESET_STREAM violates stream-level flow control */
-  setup_default_server(&conn);
-
-  conn->rx.max_offset = 1 << 21;
-
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.flags = 0;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 0;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 955;
-  fr.stream.data[0].base = null_data;
+void test_ngtcp2_conn_coalesce_flow_control_update(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_ssize spktlen;
+  int rv;
+  ngtcp2_frame fr;
+  ngtcp2_strm *strm;
+  size_t i;
+  int64_t stream_id;
+  ngtcp2_tstamp t = 100 * NGTCP2_MILLISECONDS;
+  ngtcp2_tstamp deadline;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+  setup_default_server(&conn);
 
-  CU_ASSERT(0 == rv);
+  conn->local.settings.coalesce_flow_control_update = 1;
+  conn->local.transport_params.initial_max_stream_data_bidi_remote = 2047;
+  conn->cstat.smoothed_rtt = 100 * NGTCP2_MILLISECONDS;
 
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = 4;
-  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
-  fr.reset_stream.final_size = 1024 * 1024;
+  for (i = 0; i < 3; ++i) {
+    stream_id = (int64_t)(i * 4);
+    fr.type = NGTCP2_FRAME_STREAM;
+    fr.stream.flags = 0;
+    fr.stream.stream_id = stream_id;
+    fr.stream.fin = 0;
+    fr.stream.offset = 0;
+    fr.stream.datacnt = 1;
+    fr.stream.data[0].len = i == 2 ? 2000 : 1024;
+    fr.stream.data[0].base = null_data;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
+    pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, (int64_t)i,
+                                    &fr, conn->pktns.crypto.rx.ckm);
+    rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  CU_ASSERT(NGTCP2_ERR_FLOW_CONTROL == rv);
+    CU_ASSERT(0 == rv);
+  }
 
-  ngtcp2_conn_del(conn);
+  /* ACK is sent alone because nothing has been consumed yet. */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), t);
 
-  /* Receiving RESET_STREAM for a local unidirectional stream is a
-     protocol violation. */
-  setup_default_server(&conn);
+  CU_ASSERT(spktlen > 0);
 
-  rv = ngtcp2_conn_open_uni_stream(conn, &stream_id, NULL);
+  rv = ngtcp2_conn_extend_max_stream_offset(conn, 0, 1024);
 
   CU_ASSERT(0 == rv);
 
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = stream_id;
-  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
-  fr.reset_stream.final_size = 0;
+  /* MAX_STREAM_DATA is held because the stream has plenty of credit
+     left. */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), t);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+  CU_ASSERT(0 == spktlen);
+  CU_ASSERT(t == conn->tx.flow_update.first_ts);
 
-  CU_ASSERT(NGTCP2_ERR_PROTO == rv);
+  deadline = t + conn->cstat.smoothed_rtt / 4;
 
-  ngtcp2_conn_del(conn);
+  CU_ASSERT(deadline == ngtcp2_conn_get_expiry(conn));
 
-  /* RESET_STREAM extends connection window including buffered data */
-  setup_default_server(&conn);
+  rv = ngtcp2_conn_extend_max_stream_offset(conn, 4, 1024);
 
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.flags = 0;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 0;
-  fr.stream.offset = 1;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 955;
-  fr.stream.data[0].base = null_data;
+  CU_ASSERT(0 == rv);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+  spktlen =
+      ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), deadline - 1);
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == spktlen);
 
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = 4;
-  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
-  fr.reset_stream.final_size = 1024;
+  /* Both updates are sent in a single packet at the deadline. */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), deadline);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(ngtcp2_conn_tx_strmq_empty(conn));
+  CU_ASSERT(UINT64_MAX == conn->tx.flow_update.first_ts);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(1024 == conn->rx.offset);
-  CU_ASSERT(128 * 1024 + 1024 == conn->rx.unsent_max_offset);
+  for (i = 0; i < 2; ++i) {
+    strm = ngtcp2_conn_find_stream(conn, (int64_t)(i * 4));
 
-  /* Receiving same RESET_STREAM does not increase rx offsets. */
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 3);
+    CU_ASSERT(2047 + 1024 == strm->rx.max_offset);
+  }
+
+  /* The stream which is about to be blocked gets MAX_STREAM_DATA
+     without delay. */
+  rv = ngtcp2_conn_extend_max_stream_offset(conn, 8, 2000);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(1024 == conn->rx.offset);
-  CU_ASSERT(128 * 1024 + 1024 == conn->rx.unsent_max_offset);
+  CU_ASSERT(conn->tx.flow_update.urgent);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf),
+                                  deadline + 1);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(ngtcp2_conn_tx_strmq_empty(conn));
+  CU_ASSERT(!conn->tx.flow_update.urgent);
+
+  strm = ngtcp2_conn_find_stream(conn, 8);
+
+  CU_ASSERT(2047 + 2000 == strm->rx.max_offset);
 
   ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_rx_flow_control_error(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  int rv;
+  ngtcp2_frame fr;
 
-  /* Verify that connection window is properly updated when
-     RESET_STREAM is received after sending STOP_SENDING */
   setup_default_server(&conn);
 
+  conn->local.transport_params.initial_max_data = 1024;
+  conn->rx.window = 1024;
+  conn->rx.max_offset = 1024;
+  conn->rx.unsent_max_offset = 1024;
+
   fr.type = NGTCP2_FRAME_STREAM;
   fr.stream.flags = 0;
   fr.stream.stream_id = 4;
   fr.stream.fin = 0;
-  fr.stream.offset = 1;
+  fr.stream.offset = 0;
   fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 955;
+  fr.stream.data[0].len = 1025;
   fr.stream.data[0].base = null_data;
 
   pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
                                   conn->pktns.crypto.rx.ckm);
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
+  CU_ASSERT(NGTCP2_ERR_FLOW_CONTROL == rv);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_tx_flow_control(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_ssize spktlen;
+  int rv;
+  ngtcp2_frame fr;
+  ngtcp2_ssize nwrite;
+  int64_t stream_id;
+
+  setup_default_client(&conn);
+
+  conn->remote.transport_params->initial_max_data = 2048;
+  conn->tx.max_offset = 2048;
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
   CU_ASSERT(0 == rv);
 
-  ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                           NGTCP2_WRITE_STREAM_FLAG_NONE, 4, null_data, 354, 2);
-  ngtcp2_conn_shutdown_stream_read(conn, 4, NGTCP2_APP_ERR01);
-  ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 3);
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, null_data, 1024, 1);
 
-  CU_ASSERT(128 * 1024 + 956 == conn->rx.unsent_max_offset);
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(1024 == nwrite);
+  CU_ASSERT(1024 == conn->tx.offset);
 
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = 4;
-  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
-  fr.reset_stream.final_size = 957;
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, null_data, 1023, 2);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(1023 == nwrite);
+  CU_ASSERT(1024 + 1023 == conn->tx.offset);
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, null_data, 1024, 3);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(1 == nwrite);
+  CU_ASSERT(2048 == conn->tx.offset);
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, null_data, 1024, 4);
+
+  CU_ASSERT(spktlen == 0);
+  CU_ASSERT(-1 == nwrite);
+
+  fr.type = NGTCP2_FRAME_MAX_DATA;
+  fr.max_data.max_data = 3072;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
                                   conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 4);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 5);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 4));
-  CU_ASSERT(128 * 1024 + 956 + 1 == conn->rx.unsent_max_offset);
+  CU_ASSERT(3072 == conn->tx.max_offset);
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, null_data, 1024, 4);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(1024 == nwrite);
+  CU_ASSERT(3072 == conn->tx.offset);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_recv_stop_sending(void) {
+void test_ngtcp2_conn_shutdown_stream_write(void) {
   ngtcp2_conn *conn;
   int rv;
+  ngtcp2_frame_chain *frc;
   uint8_t buf[2048];
   ngtcp2_frame fr;
   size_t pktlen;
   ngtcp2_ssize spktlen;
   ngtcp2_strm *strm;
-  ngtcp2_tstamp t = 0;
-  int64_t pkt_num = 0;
-  ngtcp2_frame_chain *frc;
   int64_t stream_id;
 
-  /* Receive STOP_SENDING */
+  /* Stream not found */
+  setup_default_server(&conn);
+
+  rv = ngtcp2_conn_shutdown_stream_write(conn, 4, NGTCP2_APP_ERR01);
+
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_conn_del(conn);
+
+  /* Check final_size */
   setup_default_client(&conn);
 
   ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
   ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
                            NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id, null_data,
-                           333, ++t);
-
-  fr.type = NGTCP2_FRAME_STOP_SENDING;
-  fr.stop_sending.stream_id = stream_id;
-  fr.stop_sending.app_error_code = NGTCP2_APP_ERR01;
-
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+                           1239, 1);
+  rv = ngtcp2_conn_shutdown_stream_write(conn, stream_id, NGTCP2_APP_ERR01);
 
   CU_ASSERT(0 == rv);
 
-  strm = ngtcp2_conn_find_stream(conn, stream_id);
-
-  CU_ASSERT(strm->flags & NGTCP2_STRM_FLAG_SHUT_WR);
-  CU_ASSERT(strm->flags & NGTCP2_STRM_FLAG_SENT_RST);
-
   for (frc = conn->pktns.tx.frq; frc; frc = frc->next) {
     if (frc->fr.type == NGTCP2_FRAME_RESET_STREAM) {
       break;
@@ -2102,87 +2394,87 @@ void test_ngtcp2_conn_recv_stop_sending(void) {
   }
 
   CU_ASSERT(NULL != frc);
+  CU_ASSERT(stream_id == frc->fr.reset_stream.stream_id);
   CU_ASSERT(NGTCP2_APP_ERR01 == frc->fr.reset_stream.app_error_code);
-  CU_ASSERT(333 == frc->fr.reset_stream.final_size);
+  CU_ASSERT(1239 == frc->fr.reset_stream.final_size);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
+
+  CU_ASSERT(NULL != strm);
+  CU_ASSERT(NGTCP2_APP_ERR01 == strm->app_error_code);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 2);
 
   CU_ASSERT(spktlen > 0);
 
-  for (frc = conn->pktns.tx.frq; frc; frc = frc->next) {
-    if (frc->fr.type == NGTCP2_FRAME_RESET_STREAM) {
-      break;
-    }
-  }
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = stream_id;
+  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
+  fr.reset_stream.final_size = 100;
 
-  CU_ASSERT(NULL == frc);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 890, &fr,
+                                  conn->pktns.crypto.rx.ckm);
 
-  /* Make sure that receiving duplicated STOP_SENDING does not trigger
-     another RESET_STREAM. */
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
 
   CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, stream_id));
 
-  strm = ngtcp2_conn_find_stream(conn, stream_id);
-
-  CU_ASSERT(strm->flags & NGTCP2_STRM_FLAG_SHUT_WR);
-  CU_ASSERT(strm->flags & NGTCP2_STRM_FLAG_SENT_RST);
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
 
-  for (frc = conn->pktns.tx.frq; frc; frc = frc->next) {
-    if (frc->fr.type == NGTCP2_FRAME_RESET_STREAM) {
-      break;
-    }
-  }
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 899, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
 
-  CU_ASSERT(NULL == frc);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL == ngtcp2_conn_find_stream(conn, stream_id));
 
   ngtcp2_conn_del(conn);
 
-  /* Receive STOP_SENDING after receiving RESET_STREAM */
+  /* Check that stream is closed when RESET_STREAM is acknowledged */
   setup_default_client(&conn);
 
   ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
-  ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                           NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id, null_data,
-                           333, ++t);
 
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = stream_id;
-  fr.reset_stream.app_error_code = NGTCP2_APP_ERR01;
-  fr.reset_stream.final_size = 0;
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = stream_id;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 0;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 119, &fr,
+                                  conn->pktns.crypto.rx.ckm);
 
-  CU_ASSERT(0 == rv);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  fr.type = NGTCP2_FRAME_STOP_SENDING;
-  fr.stop_sending.stream_id = stream_id;
-  fr.stop_sending.app_error_code = NGTCP2_APP_ERR01;
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, stream_id));
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_conn_shutdown_stream_write(conn, stream_id, NGTCP2_APP_ERR01);
 
   CU_ASSERT(0 == rv);
   CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, stream_id));
 
-  for (frc = conn->pktns.tx.frq; frc; frc = frc->next) {
-    if (frc->fr.type == NGTCP2_FRAME_RESET_STREAM) {
-      break;
-    }
-  }
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 2);
 
-  CU_ASSERT(NULL != frc);
-  CU_ASSERT(NGTCP2_APP_ERR01 == frc->fr.reset_stream.app_error_code);
-  CU_ASSERT(333 == frc->fr.reset_stream.final_size);
+  CU_ASSERT(spktlen > 0);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  /* Incoming FIN does not close stream */
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.fin = 1;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 0;
 
-  CU_ASSERT(spktlen > 0);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 121, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, stream_id));
 
   fr.type = NGTCP2_FRAME_ACK;
   fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
@@ -2190,137 +2482,145 @@ void test_ngtcp2_conn_recv_stop_sending(void) {
   fr.ack.first_ack_blklen = 0;
   fr.ack.num_blks = 0;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 332, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 3);
 
   CU_ASSERT(0 == rv);
   CU_ASSERT(NULL == ngtcp2_conn_find_stream(conn, stream_id));
 
   ngtcp2_conn_del(conn);
 
-  /* STOP_SENDING against remote bidirectional stream which has not
-     been initiated. */
-  setup_default_server(&conn);
-
-  fr.type = NGTCP2_FRAME_STOP_SENDING;
-  fr.stop_sending.stream_id = 0;
-  fr.stop_sending.app_error_code = NGTCP2_APP_ERR01;
-
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
-
-  CU_ASSERT(0 == rv);
-
-  strm = ngtcp2_conn_find_stream(conn, 0);
+  /* RESET_STREAM is not sent if all tx data are acknowledged */
+  setup_default_client(&conn);
 
-  CU_ASSERT(NULL != strm);
-  CU_ASSERT(strm->flags & NGTCP2_STRM_FLAG_SHUT_WR);
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
-  ngtcp2_conn_del(conn);
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_FIN, stream_id,
+                                     null_data, 0, 3);
 
-  /* STOP_SENDING against local bidirectional stream which has not
-     been initiated. */
-  setup_default_server(&conn);
+  CU_ASSERT(spktlen > 0);
 
-  fr.type = NGTCP2_FRAME_STOP_SENDING;
-  fr.stop_sending.stream_id = 1;
-  fr.stop_sending.app_error_code = NGTCP2_APP_ERR01;
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 999, &fr,
                                   conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  CU_ASSERT(NGTCP2_ERR_STREAM_STATE == rv);
-
-  ngtcp2_conn_del(conn);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 7);
 
-  /* Receiving STOP_SENDING for a local unidirectional stream */
-  setup_default_server(&conn);
+  CU_ASSERT(0 == rv);
 
-  rv = ngtcp2_conn_open_uni_stream(conn, &stream_id, NULL);
+  rv = ngtcp2_conn_shutdown_stream_write(conn, stream_id, NGTCP2_APP_ERR01);
 
   CU_ASSERT(0 == rv);
 
-  fr.type = NGTCP2_FRAME_STOP_SENDING;
-  fr.stop_sending.stream_id = stream_id;
-  fr.stop_sending.app_error_code = NGTCP2_APP_ERR01;
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+  CU_ASSERT(!(strm->flags & NGTCP2_STRM_FLAG_SENT_RST));
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NGTCP2_FRAME_RESET_STREAM == conn->pktns.tx.frq->fr.type);
+  spktlen =
+      ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                               NGTCP2_WRITE_STREAM_FLAG_FIN, -1, NULL, 0, 11);
+
+  CU_ASSERT(0 == spktlen);
 
   ngtcp2_conn_del(conn);
+}
 
-  /* STOP_SENDING against local unidirectional stream which has not
-     been initiated. */
+void test_ngtcp2_conn_recv_reset_stream(void) {
+  ngtcp2_conn *conn;
+  int rv;
+  uint8_t buf[2048];
+  ngtcp2_frame fr;
+  size_t pktlen;
+  ngtcp2_ssize spktlen;
+  ngtcp2_strm *strm;
+  int64_t stream_id;
+
+  /* Receive RESET_STREAM */
   setup_default_server(&conn);
 
-  fr.type = NGTCP2_FRAME_STOP_SENDING;
-  fr.stop_sending.stream_id = 3;
-  fr.stop_sending.app_error_code = NGTCP2_APP_ERR01;
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.flags = 0;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 955;
+  fr.stream.data[0].base = null_data;
 
   pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
                                   conn->pktns.crypto.rx.ckm);
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  CU_ASSERT(NGTCP2_ERR_STREAM_STATE == rv);
+  CU_ASSERT(0 == rv);
 
-  ngtcp2_conn_del(conn);
+  ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                           NGTCP2_WRITE_STREAM_FLAG_NONE, 4, null_data, 354, 2);
 
-  /* STOP_SENDING against local bidirectional stream in Data Sent
-     state.  Because all data have been acknowledged, and FIN is sent,
-     RESET_STREAM is not necessary. */
-  setup_default_client(&conn);
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = 4;
+  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
+  fr.reset_stream.final_size = 955;
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 3);
 
   CU_ASSERT(0 == rv);
 
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                                     NGTCP2_WRITE_STREAM_FLAG_FIN, stream_id,
-                                     null_data, 1, ++t);
+  strm = ngtcp2_conn_find_stream(conn, 4);
 
-  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(strm->flags & NGTCP2_STRM_FLAG_SHUT_RD);
+  CU_ASSERT(strm->flags & NGTCP2_STRM_FLAG_RECV_RST);
 
-  fr.type = NGTCP2_FRAME_ACK;
-  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
-  fr.ack.ack_delay = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
+  ngtcp2_conn_del(conn);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
+  /* Receive RESET_STREAM after sending STOP_SENDING */
+  setup_default_server(&conn);
+
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.flags = 0;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 955;
+  fr.stream.data[0].base = null_data;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
                                   conn->pktns.crypto.rx.ckm);
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
   CU_ASSERT(0 == rv);
 
-  fr.type = NGTCP2_FRAME_STOP_SENDING;
-  fr.stop_sending.stream_id = stream_id;
-  fr.stop_sending.app_error_code = NGTCP2_APP_ERR01;
+  ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                           NGTCP2_WRITE_STREAM_FLAG_NONE, 4, null_data, 354, 2);
+  ngtcp2_conn_shutdown_stream_read(conn, 4, NGTCP2_APP_ERR01);
+  ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 3);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = 4;
+  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
+  fr.reset_stream.final_size = 955;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
                                   conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 4);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL == conn->pktns.tx.frq);
+  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 4));
 
   ngtcp2_conn_del(conn);
-}
 
-void test_ngtcp2_conn_recv_conn_id_omitted(void) {
-  ngtcp2_conn *conn;
-  int rv;
-  uint8_t buf[2048];
-  ngtcp2_frame fr;
-  size_t pktlen;
-  ngtcp2_ksl_it it;
-  ngtcp2_scid *scid;
+  /* Receive RESET_STREAM after sending RESET_STREAM */
+  setup_default_server(&conn);
 
   fr.type = NGTCP2_FRAME_STREAM;
   fr.stream.flags = 0;
@@ -2328,2400 +2628,2495 @@ void test_ngtcp2_conn_recv_conn_id_omitted(void) {
   fr.stream.fin = 0;
   fr.stream.offset = 0;
   fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 100;
+  fr.stream.data[0].len = 955;
   fr.stream.data[0].base = null_data;
 
-  /* Receiving packet which has no connection ID while SCID of server
-     is not empty. */
-  setup_default_server(&conn);
-
-  pktlen = write_single_frame_pkt_without_conn_id(buf, sizeof(buf), 1, &fr,
-                                                  conn->pktns.crypto.rx.ckm);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  /* packet is just ignored */
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                           NGTCP2_WRITE_STREAM_FLAG_NONE, 4, null_data, 354, 2);
+  ngtcp2_conn_shutdown_stream_write(conn, 4, NGTCP2_APP_ERR01);
+  ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 3);
+
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = 4;
+  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
+  fr.reset_stream.final_size = 955;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 4);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 4));
+
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 3, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 5);
+
   CU_ASSERT(0 == rv);
   CU_ASSERT(NULL == ngtcp2_conn_find_stream(conn, 4));
 
   ngtcp2_conn_del(conn);
 
-  /* Allow omission of connection ID */
+  /* Receive RESET_STREAM after receiving STOP_SENDING */
   setup_default_server(&conn);
-  ngtcp2_cid_zero(&conn->oscid);
 
-  it = ngtcp2_ksl_begin(&conn->scid.set);
-  scid = ngtcp2_ksl_it_get(&it);
-  ngtcp2_cid_zero(&scid->cid);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.flags = 0;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 955;
+  fr.stream.data[0].base = null_data;
 
-  pktlen = write_single_frame_pkt_without_conn_id(buf, sizeof(buf), 1, &fr,
-                                                  conn->pktns.crypto.rx.ckm);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 4));
 
-  ngtcp2_conn_del(conn);
-}
+  ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                           NGTCP2_WRITE_STREAM_FLAG_NONE, 4, null_data, 354, 2);
 
-void test_ngtcp2_conn_short_pkt_type(void) {
-  ngtcp2_conn *conn;
-  ngtcp2_pkt_hd hd;
-  uint8_t buf[2048];
-  ngtcp2_ssize spktlen;
-  int64_t stream_id;
+  fr.type = NGTCP2_FRAME_STOP_SENDING;
+  fr.stop_sending.stream_id = 4;
+  fr.stop_sending.app_error_code = NGTCP2_APP_ERR01;
 
-  /* 1 octet pkt num */
-  setup_default_client(&conn);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 3);
 
-  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                     null_data, 19, 1);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 4));
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 4);
 
   CU_ASSERT(spktlen > 0);
-  CU_ASSERT(pkt_decode_hd_short_mask(&hd, buf, (size_t)spktlen,
-                                     conn->oscid.datalen) > 0);
-  CU_ASSERT(1 == hd.pkt_numlen);
 
-  ngtcp2_conn_del(conn);
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = 4;
+  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
+  fr.reset_stream.final_size = 955;
 
-  /* 2 octets pkt num */
-  setup_default_client(&conn);
-  conn->pktns.rtb.largest_acked_tx_pkt_num = 0x6afa2f;
-  conn->pktns.tx.last_pkt_num = 0x6afd78;
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 3, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 4);
 
-  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                     null_data, 19, 1);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 4));
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(pkt_decode_hd_short_mask(&hd, buf, (size_t)spktlen,
-                                     conn->oscid.datalen) > 0);
-  CU_ASSERT(2 == hd.pkt_numlen);
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 4, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 5);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL == ngtcp2_conn_find_stream(conn, 4));
 
   ngtcp2_conn_del(conn);
 
-  /* 4 octets pkt num */
-  setup_default_client(&conn);
-  conn->pktns.rtb.largest_acked_tx_pkt_num = 0x6afa2f;
-  conn->pktns.tx.last_pkt_num = 0x6bc106;
+  /* final_size in RESET_STREAM exceeds the already received offset */
+  setup_default_server(&conn);
 
-  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                     null_data, 19, 1);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.flags = 0;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 955;
+  fr.stream.data[0].base = null_data;
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(pkt_decode_hd_short_mask(&hd, buf, (size_t)spktlen,
-                                     conn->oscid.datalen) > 0);
-  CU_ASSERT(3 == hd.pkt_numlen);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  ngtcp2_conn_del(conn);
+  CU_ASSERT(0 == rv);
 
-  /* 1 octet pkt num (largest)*/
-  setup_default_client(&conn);
-  conn->pktns.rtb.largest_acked_tx_pkt_num = 1;
-  conn->pktns.tx.last_pkt_num = 128;
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = 4;
+  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
+  fr.reset_stream.final_size = 954;
 
-  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                     null_data, 19, 1);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(pkt_decode_hd_short_mask(&hd, buf, (size_t)spktlen,
-                                     conn->oscid.datalen) > 0);
-  CU_ASSERT(1 == hd.pkt_numlen);
+  CU_ASSERT(NGTCP2_ERR_FINAL_SIZE == rv);
 
   ngtcp2_conn_del(conn);
 
-  /* 2 octet pkt num (shortest)*/
-  setup_default_client(&conn);
-  conn->pktns.rtb.largest_acked_tx_pkt_num = 1;
-  conn->pktns.tx.last_pkt_num = 129;
+  /* final_size in RESET_STREAM differs from the final offset which
+     STREAM frame with fin indicated. */
+  setup_default_server(&conn);
 
-  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                     null_data, 19, 1);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.flags = 0;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 1;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 955;
+  fr.stream.data[0].base = null_data;
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(pkt_decode_hd_short_mask(&hd, buf, (size_t)spktlen,
-                                     conn->oscid.datalen) > 0);
-  CU_ASSERT(2 == hd.pkt_numlen);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  ngtcp2_conn_del(conn);
+  CU_ASSERT(0 == rv);
 
-  /* 2 octet pkt num (largest)*/
-  setup_default_client(&conn);
-  conn->pktns.rtb.largest_acked_tx_pkt_num = 1;
-  conn->pktns.tx.last_pkt_num = 32768;
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = 4;
+  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
+  fr.reset_stream.final_size = 956;
 
-  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                     null_data, 19, 1);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(
-      pkt_decode_hd_short(&hd, buf, (size_t)spktlen, conn->oscid.datalen) > 0);
-  CU_ASSERT(2 == hd.pkt_numlen);
+  CU_ASSERT(NGTCP2_ERR_FINAL_SIZE == rv);
 
   ngtcp2_conn_del(conn);
 
-  /* 3 octet pkt num (shortest) */
-  setup_default_client(&conn);
-  conn->pktns.rtb.largest_acked_tx_pkt_num = 1;
-  conn->pktns.tx.last_pkt_num = 32769;
+  /* RESET_STREAM against local stream which has not been initiated. */
+  setup_default_server(&conn);
 
-  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                     null_data, 19, 1);
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = 1;
+  fr.reset_stream.app_error_code = NGTCP2_APP_ERR01;
+  fr.reset_stream.final_size = 0;
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(
-      pkt_decode_hd_short(&hd, buf, (size_t)spktlen, conn->oscid.datalen) > 0);
-  CU_ASSERT(3 == hd.pkt_numlen);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+
+  CU_ASSERT(NGTCP2_ERR_STREAM_STATE == rv);
 
   ngtcp2_conn_del(conn);
 
-  /* 3 octet pkt num (largest) */
-  setup_default_client(&conn);
-  conn->pktns.rtb.largest_acked_tx_pkt_num = 1;
-  conn->pktns.tx.last_pkt_num = 8388608;
+  /* RESET_STREAM against remote stream which has not been initiated */
+  setup_default_server(&conn);
 
-  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                     null_data, 19, 1);
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = 0;
+  fr.reset_stream.app_error_code = NGTCP2_APP_ERR01;
+  fr.reset_stream.final_size = 1999;
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(
-      pkt_decode_hd_short(&hd, buf, (size_t)spktlen, conn->oscid.datalen) > 0);
-  CU_ASSERT(3 == hd.pkt_numlen);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL == ngtcp2_conn_find_stream(conn, 0));
+  CU_ASSERT(4 == conn->remote.bidi.unsent_max_streams);
 
   ngtcp2_conn_del(conn);
 
-  /* 4 octet pkt num (shortest)*/
-  setup_default_client(&conn);
-  conn->pktns.rtb.largest_acked_tx_pkt_num = 1;
-  conn->pktns.tx.last_pkt_num = 8388609;
+  /* RESET_STREAM against remote stream which is larger than allowed
+     maximum */
+  setup_default_server(&conn);
 
-  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                     null_data, 19, 1);
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = 16;
+  fr.reset_stream.app_error_code = NGTCP2_APP_ERR01;
+  fr.reset_stream.final_size = 0;
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(
-      pkt_decode_hd_short(&hd, buf, (size_t)spktlen, conn->oscid.datalen) > 0);
-  CU_ASSERT(4 == hd.pkt_numlen);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+
+  CU_ASSERT(NGTCP2_ERR_STREAM_LIMIT == rv);
 
   ngtcp2_conn_del(conn);
 
-  /* Overflow */
-  setup_default_client(&conn);
-  conn->pktns.rtb.largest_acked_tx_pkt_num = 1;
-  conn->pktns.tx.last_pkt_num = NGTCP2_MAX_PKT_NUM - 1;
+  /* RESET_STREAM against remote stream which is allowed, and no
+     ngtcp2_strm object has been created */
+  setup_default_server(&conn);
 
-  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                     null_data, 19, 1);
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = 4;
+  fr.reset_stream.app_error_code = NGTCP2_APP_ERR01;
+  fr.reset_stream.final_size = 0;
 
-  CU_ASSERT(spktlen > 0);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+
+  CU_ASSERT(0 == rv);
   CU_ASSERT(
-      pkt_decode_hd_short(&hd, buf, (size_t)spktlen, conn->oscid.datalen) > 0);
-  CU_ASSERT(4 == hd.pkt_numlen);
+      ngtcp2_idtr_is_open(&conn->remote.bidi.idtr, fr.reset_stream.stream_id));
 
   ngtcp2_conn_del(conn);
-}
 
-void test_ngtcp2_conn_recv_stateless_reset(void) {
-  ngtcp2_conn *conn;
-  uint8_t buf[256];
-  ngtcp2_ssize spktlen;
-  int rv;
-  size_t i;
-  uint8_t token[NGTCP2_STATELESS_RESET_TOKENLEN];
-
-  for (i = 0; i < NGTCP2_STATELESS_RESET_TOKENLEN; ++i) {
-    token[i] = (uint8_t)~i;
-  }
-
-  /* server */
+  /* RESET_STREAM against remote stream which is allowed, and no
+     ngtcp2_strm object has been created, and final_size violates
+     connection-level flow control. */
   setup_default_server(&conn);
-  conn->callbacks.decrypt = fail_decrypt;
-  conn->pktns.rx.max_pkt_num = 24324325;
-
-  ngtcp2_dcid_set_token(&conn->dcid.current, token);
 
-  spktlen = ngtcp2_pkt_write_stateless_reset(
-      buf, sizeof(buf), token, null_data, NGTCP2_MIN_STATELESS_RESET_RANDLEN);
+  conn->local.transport_params.initial_max_stream_data_bidi_remote = 1 << 21;
 
-  CU_ASSERT(spktlen > 0);
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = 4;
+  fr.reset_stream.app_error_code = NGTCP2_APP_ERR01;
+  fr.reset_stream.final_size = 1 << 20;
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
-                            (size_t)spktlen, 1);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  CU_ASSERT(NGTCP2_ERR_DRAINING == rv);
-  CU_ASSERT(NGTCP2_CS_DRAINING == conn->state);
+  CU_ASSERT(NGTCP2_ERR_FLOW_CONTROL == rv);
 
   ngtcp2_conn_del(conn);
 
-  /* client */
-  setup_default_client(&conn);
-  conn->callbacks.decrypt = fail_decrypt;
-  conn->pktns.rx.max_pkt_num = 3255454;
-
-  ngtcp2_dcid_set_token(&conn->dcid.current, token);
+  /* RESET_STREAM against remote stream which is allowed, and no
+      ngtcp2_strm object has been created, and final_size violates
+      stream-level flow control. */
+  setup_default_server(&conn);
 
-  spktlen =
-      ngtcp2_pkt_write_stateless_reset(buf, sizeof(buf), token, null_data, 29);
+  conn->rx.max_offset = 1 << 21;
 
-  CU_ASSERT(spktlen > 0);
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = 4;
+  fr.reset_stream.app_error_code = NGTCP2_APP_ERR01;
+  fr.reset_stream.final_size = 1 << 20;
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
-                            (size_t)spktlen, 1);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  CU_ASSERT(NGTCP2_ERR_DRAINING == rv);
-  CU_ASSERT(NGTCP2_CS_DRAINING == conn->state);
+  CU_ASSERT(NGTCP2_ERR_FLOW_CONTROL == rv);
 
   ngtcp2_conn_del(conn);
 
-  /* stateless reset in long packet */
+  /* final_size in RESET_STREAM violates connection-level flow
+     control */
   setup_default_server(&conn);
-  conn->callbacks.decrypt = fail_decrypt;
-  conn->pktns.rx.max_pkt_num = 754233;
 
-  ngtcp2_dcid_set_token(&conn->dcid.current, token);
+  conn->local.transport_params.initial_max_stream_data_bidi_remote = 1 << 21;
 
-  spktlen = ngtcp2_pkt_write_stateless_reset(
-      buf, sizeof(buf), token, null_data, NGTCP2_MIN_STATELESS_RESET_RANDLEN);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.flags = 0;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 955;
+  fr.stream.data[0].base = null_data;
 
-  CU_ASSERT(spktlen > 0);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  /* long packet */
-  buf[0] |= NGTCP2_HEADER_FORM_BIT;
+  CU_ASSERT(0 == rv);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
-                            (size_t)spktlen, 1);
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = 4;
+  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
+  fr.reset_stream.final_size = 1024 * 1024;
 
-  CU_ASSERT(NGTCP2_ERR_DRAINING == rv);
-  CU_ASSERT(NGTCP2_CS_DRAINING == conn->state);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
+
+  CU_ASSERT(NGTCP2_ERR_FLOW_CONTROL == rv);
 
   ngtcp2_conn_del(conn);
 
-  /* stateless reset in long packet; parsing long header fails */
+  /* final_size in RESET_STREAM violates stream-level flow control */
   setup_default_server(&conn);
-  conn->callbacks.decrypt = fail_decrypt;
-  conn->pktns.rx.max_pkt_num = 754233;
-
-  ngtcp2_dcid_set_token(&conn->dcid.current, token);
 
-  spktlen = ngtcp2_pkt_write_stateless_reset(
-      buf, 41, token, null_data, NGTCP2_MIN_STATELESS_RESET_RANDLEN);
+  conn->rx.max_offset = 1 << 21;
 
-  CU_ASSERT(spktlen > 0);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.flags = 0;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 955;
+  fr.stream.data[0].base = null_data;
 
-  /* long packet */
-  buf[0] |= NGTCP2_HEADER_FORM_BIT;
-  buf[0] |= 0x30;
-  /* Make version nonzero so that it does not look like Version
-     Negotiation packet */
-  buf[1] = 0xff;
-  /* Make largest CID so that ngtcp2_pkt_decode_hd_long fails */
-  buf[5] = 0xff;
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
-                            (size_t)spktlen, 1);
+  CU_ASSERT(0 == rv);
 
-  CU_ASSERT(NGTCP2_ERR_DRAINING == rv);
-  CU_ASSERT(NGTCP2_CS_DRAINING == conn->state);
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = 4;
+  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
+  fr.reset_stream.final_size = 1024 * 1024;
 
-  ngtcp2_conn_del(conn);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
 
-  /* token does not match */
-  setup_default_client(&conn);
-  conn->callbacks.decrypt = fail_decrypt;
-  conn->pktns.rx.max_pkt_num = 24324325;
+  CU_ASSERT(NGTCP2_ERR_FLOW_CONTROL == rv);
 
-  spktlen =
-      ngtcp2_pkt_write_stateless_reset(buf, sizeof(buf), token, null_data, 29);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(spktlen > 0);
+  /* Receiving RESET_STREAM for a local unidirectional stream is a
+     protocol violation. */
+  setup_default_server(&conn);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
-                            (size_t)spktlen, 1);
+  rv = ngtcp2_conn_open_uni_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NGTCP2_CS_DRAINING != conn->state);
 
-  ngtcp2_conn_del(conn);
-}
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = stream_id;
+  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
+  fr.reset_stream.final_size = 0;
 
-void test_ngtcp2_conn_recv_retry(void) {
-  ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  ngtcp2_ssize spktlen;
-  uint64_t t = 0;
-  ngtcp2_cid dcid;
-  const uint8_t token[] = "address-validation-token";
-  size_t i;
-  int64_t stream_id;
-  ngtcp2_ssize datalen;
-  int rv;
-  ngtcp2_vec datav;
-  ngtcp2_strm *strm;
-  ngtcp2_crypto_aead aead = {0};
-  ngtcp2_crypto_aead_ctx aead_ctx = {0};
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  dcid_init(&dcid);
-  setup_handshake_client(&conn);
-  conn->callbacks.recv_retry = recv_retry;
+  CU_ASSERT(NGTCP2_ERR_PROTO == rv);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(spktlen > 0);
+  /* RESET_STREAM extends connection window including buffered data */
+  setup_default_server(&conn);
 
-  spktlen = ngtcp2_pkt_write_retry(
-      buf, sizeof(buf), NGTCP2_PROTO_VER_V1, &conn->oscid, &dcid,
-      ngtcp2_conn_get_dcid(conn), token, strsize(token), null_encrypt, &aead,
-      &aead_ctx);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.flags = 0;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 1;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 955;
+  fr.stream.data[0].base = null_data;
 
-  CU_ASSERT(spktlen > 0);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  for (i = 0; i < 2; ++i) {
-    rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
-                              (size_t)spktlen, ++t);
+  CU_ASSERT(0 == rv);
 
-    CU_ASSERT(0 == rv);
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = 4;
+  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
+  fr.reset_stream.final_size = 1024;
 
-    spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
 
-    if (i == 1) {
-      /* Retry packet was ignored */
-      CU_ASSERT(spktlen == 0);
-    } else {
-      CU_ASSERT(spktlen > 0);
-      CU_ASSERT(1 == conn->in_pktns->tx.last_pkt_num);
-      CU_ASSERT(ngtcp2_cid_eq(&dcid, ngtcp2_conn_get_dcid(conn)));
-      CU_ASSERT(conn->flags & NGTCP2_CONN_FLAG_RECV_RETRY);
-    }
-  }
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1024 == conn->rx.offset);
+  CU_ASSERT(128 * 1024 + 1024 == conn->rx.unsent_max_offset);
+
+  /* Receiving same RESET_STREAM does not increase rx offsets. */
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 3);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1024 == conn->rx.offset);
+  CU_ASSERT(128 * 1024 + 1024 == conn->rx.unsent_max_offset);
 
   ngtcp2_conn_del(conn);
 
-  /* Retry packet with non-matching tag is rejected */
-  setup_handshake_client(&conn);
-  conn->callbacks.recv_retry = recv_retry;
+  /* Verify that connection window is properly updated when
+     RESET_STREAM is received after sending STOP_SENDING */
+  setup_default_server(&conn);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.flags = 0;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 1;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 955;
+  fr.stream.data[0].base = null_data;
 
-  CU_ASSERT(spktlen > 0);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  spktlen = ngtcp2_pkt_write_retry(
-      buf, sizeof(buf), NGTCP2_PROTO_VER_V1, &conn->oscid, &dcid,
-      ngtcp2_conn_get_dcid(conn), token, strsize(token), null_encrypt, &aead,
-      &aead_ctx);
+  CU_ASSERT(0 == rv);
 
-  CU_ASSERT(spktlen > 0);
+  ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                           NGTCP2_WRITE_STREAM_FLAG_NONE, 4, null_data, 354, 2);
+  ngtcp2_conn_shutdown_stream_read(conn, 4, NGTCP2_APP_ERR01);
+  ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 3);
 
-  /* Change tag */
-  buf[spktlen - 1] = 1;
+  CU_ASSERT(128 * 1024 + 956 == conn->rx.unsent_max_offset);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
-                            (size_t)spktlen, ++t);
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = 4;
+  fr.reset_stream.app_error_code = NGTCP2_APP_ERR02;
+  fr.reset_stream.final_size = 957;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 4);
 
   CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 4));
+  CU_ASSERT(128 * 1024 + 956 + 1 == conn->rx.unsent_max_offset);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  ngtcp2_conn_del(conn);
+}
 
-  CU_ASSERT(0 == spktlen);
+void test_ngtcp2_conn_recv_stop_sending(void) {
+  ngtcp2_conn *conn;
+  int rv;
+  uint8_t buf[2048];
+  ngtcp2_frame fr;
+  size_t pktlen;
+  ngtcp2_ssize spktlen;
+  ngtcp2_strm *strm;
+  ngtcp2_tstamp t = 0;
+  int64_t pkt_num = 0;
+  ngtcp2_frame_chain *frc;
+  int64_t stream_id;
 
-  ngtcp2_conn_del(conn);
+  /* Receive STOP_SENDING */
+  setup_default_client(&conn);
 
-  /* Make sure that 0RTT packets are retransmitted */
-  setup_early_client(&conn);
-  conn->callbacks.recv_retry = recv_retry;
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                           NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id, null_data,
+                           333, ++t);
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  fr.type = NGTCP2_FRAME_STOP_SENDING;
+  fr.stop_sending.stream_id = stream_id;
+  fr.stop_sending.app_error_code = NGTCP2_APP_ERR01;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
 
-  spktlen =
-      ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, sizeof(buf), &datalen,
-                                NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                null_datav(&datav, 219), 1, ++t);
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
 
-  CU_ASSERT(sizeof(buf) == spktlen);
-  CU_ASSERT(219 == datalen);
+  CU_ASSERT(strm->flags & NGTCP2_STRM_FLAG_SHUT_WR);
+  CU_ASSERT(strm->flags & NGTCP2_STRM_FLAG_SENT_RST);
 
-  spktlen =
-      ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, sizeof(buf), &datalen,
-                                NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                null_datav(&datav, 119), 1, ++t);
+  for (frc = conn->pktns.tx.frq; frc; frc = frc->next) {
+    if (frc->fr.type == NGTCP2_FRAME_RESET_STREAM) {
+      break;
+    }
+  }
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(119 == datalen);
+  CU_ASSERT(NULL != frc);
+  CU_ASSERT(NGTCP2_APP_ERR01 == frc->fr.reset_stream.app_error_code);
+  CU_ASSERT(333 == frc->fr.reset_stream.final_size);
 
-  spktlen = ngtcp2_pkt_write_retry(
-      buf, sizeof(buf), NGTCP2_PROTO_VER_V1, &conn->oscid, &dcid,
-      ngtcp2_conn_get_dcid(conn), token, strsize(token), null_encrypt, &aead,
-      &aead_ctx);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
   CU_ASSERT(spktlen > 0);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
-                            (size_t)spktlen, ++t);
+  for (frc = conn->pktns.tx.frq; frc; frc = frc->next) {
+    if (frc->fr.type == NGTCP2_FRAME_RESET_STREAM) {
+      break;
+    }
+  }
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL == frc);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  /* Make sure that receiving duplicated STOP_SENDING does not trigger
+     another RESET_STREAM. */
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  /* Make sure that resent 0RTT packet is padded */
-  CU_ASSERT(sizeof(buf) == spktlen);
-  CU_ASSERT(2 == conn->pktns.tx.last_pkt_num);
+  CU_ASSERT(0 == rv);
 
   strm = ngtcp2_conn_find_stream(conn, stream_id);
 
-  CU_ASSERT(0 == ngtcp2_ksl_len(strm->tx.streamfrq));
+  CU_ASSERT(strm->flags & NGTCP2_STRM_FLAG_SHUT_WR);
+  CU_ASSERT(strm->flags & NGTCP2_STRM_FLAG_SENT_RST);
 
-  /* ngtcp2_conn_write_stream sends new 0RTT packet. */
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
-                                     &datalen, NGTCP2_WRITE_STREAM_FLAG_NONE,
-                                     stream_id, null_data, 120, ++t);
+  for (frc = conn->pktns.tx.frq; frc; frc = frc->next) {
+    if (frc->fr.type == NGTCP2_FRAME_RESET_STREAM) {
+      break;
+    }
+  }
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(3 == conn->pktns.tx.last_pkt_num);
-  CU_ASSERT(120 == datalen);
-  CU_ASSERT(NULL == conn->pktns.tx.frq);
-  CU_ASSERT(!ngtcp2_rtb_empty(&conn->pktns.rtb));
+  CU_ASSERT(NULL == frc);
 
   ngtcp2_conn_del(conn);
-}
-
-void test_ngtcp2_conn_recv_delayed_handshake_pkt(void) {
-  ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  size_t pktlen;
-  ngtcp2_frame fr;
-  int rv;
 
+  /* Receive STOP_SENDING after receiving RESET_STREAM */
   setup_default_client(&conn);
 
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 567;
-  fr.crypto.data[0].base = null_data;
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                           NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id, null_data,
+                           333, ++t);
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_HANDSHAKE, &conn->oscid,
-      ngtcp2_conn_get_dcid(conn), 1, NGTCP2_PROTO_VER_V1, &fr, &null_ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = stream_id;
+  fr.reset_stream.app_error_code = NGTCP2_APP_ERR01;
+  fr.reset_stream.final_size = 0;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(1 == ngtcp2_ksl_len(&conn->hs_pktns->acktr.ents));
 
-  ngtcp2_conn_del(conn);
-}
+  fr.type = NGTCP2_FRAME_STOP_SENDING;
+  fr.stop_sending.stream_id = stream_id;
+  fr.stop_sending.app_error_code = NGTCP2_APP_ERR01;
 
-void test_ngtcp2_conn_recv_max_streams(void) {
-  ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  size_t pktlen;
-  int rv;
-  ngtcp2_frame fr;
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  setup_default_client(&conn);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, stream_id));
 
-  fr.type = NGTCP2_FRAME_MAX_STREAMS_UNI;
-  fr.max_streams.max_streams = 999;
+  for (frc = conn->pktns.tx.frq; frc; frc = frc->next) {
+    if (frc->fr.type == NGTCP2_FRAME_RESET_STREAM) {
+      break;
+    }
+  }
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
+  CU_ASSERT(NULL != frc);
+  CU_ASSERT(NGTCP2_APP_ERR01 == frc->fr.reset_stream.app_error_code);
+  CU_ASSERT(333 == frc->fr.reset_stream.final_size);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(999 == conn->local.uni.max_streams);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  fr.type = NGTCP2_FRAME_MAX_STREAMS_BIDI;
-  fr.max_streams.max_streams = 997;
+  CU_ASSERT(spktlen > 0);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(997 == conn->local.bidi.max_streams);
+  CU_ASSERT(NULL == ngtcp2_conn_find_stream(conn, stream_id));
 
   ngtcp2_conn_del(conn);
-}
 
-void test_ngtcp2_conn_handshake(void) {
-  ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  size_t pktlen;
-  ngtcp2_ssize spktlen;
-  ngtcp2_frame fr;
-  int64_t pkt_num = 12345689;
-  ngtcp2_tstamp t = 0;
-  ngtcp2_cid rcid;
-  int rv;
-  int64_t stream_id;
-  ngtcp2_ssize nwrite;
-  ngtcp2_crypto_aead_ctx aead_ctx = {0};
-  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
-  ngtcp2_crypto_ctx crypto_ctx;
-
-  rcid_init(&rcid);
-
-  /* Make sure server Initial is padded */
-  setup_handshake_server(&conn);
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 1200;
-  fr.crypto.data[0].base = null_data;
+  /* STOP_SENDING against remote bidirectional stream which has not
+     been initiated. */
+  setup_default_server(&conn);
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid, ngtcp2_conn_get_dcid(conn),
-      ++pkt_num, conn->client_chosen_version, &fr, &null_ckm);
+  fr.type = NGTCP2_FRAME_STOP_SENDING;
+  fr.stop_sending.stream_id = 0;
+  fr.stop_sending.app_error_code = NGTCP2_APP_ERR01;
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
   CU_ASSERT(0 == rv);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  strm = ngtcp2_conn_find_stream(conn, 0);
 
-  CU_ASSERT(spktlen >= 1200);
+  CU_ASSERT(NULL != strm);
+  CU_ASSERT(strm->flags & NGTCP2_STRM_FLAG_SHUT_WR);
 
   ngtcp2_conn_del(conn);
 
-  /* Make sure server Handshake is padded when ack-eliciting Initial
-     is coalesced. */
-  setup_handshake_server(&conn);
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 1200;
-  fr.crypto.data[0].base = null_data;
-
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid, ngtcp2_conn_get_dcid(conn),
-      ++pkt_num, conn->client_chosen_version, &fr, &null_ckm);
+  /* STOP_SENDING against local bidirectional stream which has not
+     been initiated. */
+  setup_default_server(&conn);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  fr.type = NGTCP2_FRAME_STOP_SENDING;
+  fr.stop_sending.stream_id = 1;
+  fr.stop_sending.app_error_code = NGTCP2_APP_ERR01;
 
-  CU_ASSERT(0 == rv);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  ngtcp2_conn_submit_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_HANDSHAKE, null_data,
-                                 91);
+  CU_ASSERT(NGTCP2_ERR_STREAM_STATE == rv);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(spktlen >= 1200);
-  CU_ASSERT(1 == ngtcp2_ksl_len(&conn->hs_pktns->rtb.ents));
+  /* Receiving STOP_SENDING for a local unidirectional stream */
+  setup_default_server(&conn);
 
-  ngtcp2_conn_del(conn);
+  rv = ngtcp2_conn_open_uni_stream(conn, &stream_id, NULL);
 
-  /* Make sure that client packet is padded if it includes Initial and
-     0RTT packets */
-  setup_early_client(&conn);
+  CU_ASSERT(0 == rv);
 
-  conn->callbacks.client_initial = client_initial_large_crypto_early_data;
+  fr.type = NGTCP2_FRAME_STOP_SENDING;
+  fr.stop_sending.stream_id = stream_id;
+  fr.stop_sending.app_error_code = NGTCP2_APP_ERR01;
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
   CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_FRAME_RESET_STREAM == conn->pktns.tx.frq->fr.type);
 
-  /* First packet should only includes Initial.  No space for 0RTT. */
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, 1280, &nwrite,
-                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                     null_data, 10, ++t);
-
-  CU_ASSERT(1280 == spktlen);
-  CU_ASSERT(-1 == nwrite);
+  ngtcp2_conn_del(conn);
 
-  /* Second packet has a room for 0RTT. */
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, 1280, &nwrite,
-                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                     null_data, 10, ++t);
+  /* STOP_SENDING against local unidirectional stream which has not
+     been initiated. */
+  setup_default_server(&conn);
 
-  CU_ASSERT(1280 == spktlen);
-  CU_ASSERT(10 == nwrite);
+  fr.type = NGTCP2_FRAME_STOP_SENDING;
+  fr.stop_sending.stream_id = 3;
+  fr.stop_sending.app_error_code = NGTCP2_APP_ERR01;
 
-  /* We have no data to send. */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, 1280, ++t);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  CU_ASSERT(0 == spktlen);
+  CU_ASSERT(NGTCP2_ERR_STREAM_STATE == rv);
 
   ngtcp2_conn_del(conn);
 
-  /* Make sure that client non ack-eliciting Initial triggers
-     padding. */
-  setup_handshake_client(&conn);
+  /* STOP_SENDING against local bidirectional stream in Data Sent
+     state.  Because all data have been acknowledged, and FIN is sent,
+     RESET_STREAM is not necessary. */
+  setup_default_client(&conn);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
-  CU_ASSERT(spktlen >= 1200);
+  CU_ASSERT(0 == rv);
 
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 1200;
-  fr.crypto.data[0].base = null_data;
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_FIN, stream_id,
+                                     null_data, 1, ++t);
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
-      ngtcp2_conn_get_dcid(conn), ++pkt_num, conn->client_chosen_version, &fr,
-      &null_ckm);
+  CU_ASSERT(spktlen > 0);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
 
-  CU_ASSERT(0 == rv);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  init_crypto_ctx(&crypto_ctx);
-  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
-  ngtcp2_conn_install_rx_handshake_key(conn, &aead_ctx, null_iv,
-                                       sizeof(null_iv), &hp_ctx);
-  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
-                                       sizeof(null_iv), &hp_ctx);
+  CU_ASSERT(0 == rv);
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_HANDSHAKE, &conn->oscid,
-      ngtcp2_conn_get_dcid(conn), ++pkt_num, conn->client_chosen_version, &fr,
-      &null_ckm);
+  fr.type = NGTCP2_FRAME_STOP_SENDING;
+  fr.stop_sending.stream_id = stream_id;
+  fr.stop_sending.app_error_code = NGTCP2_APP_ERR01;
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
   CU_ASSERT(0 == rv);
-
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
-
-  CU_ASSERT(spktlen >= 1200);
+  CU_ASSERT(NULL == conn->pktns.tx.frq);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_handshake_error(void) {
+void test_ngtcp2_conn_recv_conn_id_omitted(void) {
   ngtcp2_conn *conn;
+  int rv;
   uint8_t buf[2048];
-  size_t pktlen;
-  ngtcp2_ssize spktlen;
   ngtcp2_frame fr;
-  int64_t pkt_num = 107;
-  ngtcp2_tstamp t = 0;
-  ngtcp2_cid rcid;
-  int rv;
-
-  rcid_init(&rcid);
-
-  /* client side */
-  setup_handshake_client(&conn);
-  conn->callbacks.recv_crypto_data = recv_crypto_handshake_error;
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
-
-  CU_ASSERT(spktlen > 0);
+  size_t pktlen;
+  ngtcp2_ksl_it it;
+  ngtcp2_scid *scid;
 
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 333;
-  fr.crypto.data[0].base = null_data;
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.flags = 0;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 100;
+  fr.stream.data[0].base = null_data;
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
-      ngtcp2_conn_get_dcid(conn), ++pkt_num, conn->client_chosen_version, &fr,
-      &null_ckm);
+  /* Receiving packet which has no connection ID while SCID of server
+     is not empty. */
+  setup_default_server(&conn);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  pktlen = write_single_frame_pkt_without_conn_id(buf, sizeof(buf), 1, &fr,
+                                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  CU_ASSERT(NGTCP2_ERR_CRYPTO == rv);
+  /* packet is just ignored */
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL == ngtcp2_conn_find_stream(conn, 4));
 
   ngtcp2_conn_del(conn);
 
-  /* server side */
-  setup_handshake_server(&conn);
-  conn->callbacks.recv_crypto_data = recv_crypto_handshake_error;
-
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 1200;
-  fr.crypto.data[0].base = null_data;
+  /* Allow omission of connection ID */
+  setup_default_server(&conn);
+  ngtcp2_cid_zero(&conn->oscid);
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid, ngtcp2_conn_get_dcid(conn),
-      ++pkt_num, conn->client_chosen_version, &fr, &null_ckm);
+  it = ngtcp2_ksl_begin(&conn->scid.set);
+  scid = ngtcp2_ksl_it_get(&it);
+  ngtcp2_cid_zero(&scid->cid);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  pktlen = write_single_frame_pkt_without_conn_id(buf, sizeof(buf), 1, &fr,
+                                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  CU_ASSERT(NGTCP2_ERR_CRYPTO == rv);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 4));
 
   ngtcp2_conn_del(conn);
+}
 
-  /* server side; wrong version */
-  setup_handshake_server(&conn);
-  conn->callbacks.recv_crypto_data = recv_crypto_handshake_error;
+void test_ngtcp2_conn_short_pkt_type(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_pkt_hd hd;
+  uint8_t buf[2048];
+  ngtcp2_ssize spktlen;
+  int64_t stream_id;
 
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 1201;
-  fr.crypto.data[0].base = null_data;
-
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid, ngtcp2_conn_get_dcid(conn),
-      ++pkt_num, 0xffff, &fr, &null_ckm);
+  /* 1 octet pkt num */
+  setup_default_client(&conn);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 19, 1);
 
-  CU_ASSERT(NGTCP2_ERR_DROP_CONN == rv);
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(pkt_decode_hd_short_mask(&hd, buf, (size_t)spktlen,
+                                     conn->oscid.datalen) > 0);
+  CU_ASSERT(1 == hd.pkt_numlen);
 
   ngtcp2_conn_del(conn);
-}
-
-void test_ngtcp2_conn_retransmit_protected(void) {
-  ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  ngtcp2_ssize spktlen;
-  ngtcp2_tstamp t = 0;
-  int64_t stream_id, stream_id_a, stream_id_b;
-  ngtcp2_ksl_it it;
-  ngtcp2_frame fr;
-  size_t pktlen;
-  ngtcp2_vec datav;
-  int accepted;
-  int rv;
-  ngtcp2_strm *strm;
 
-  /* Retransmit a packet completely */
+  /* 2 octets pkt num */
   setup_default_client(&conn);
+  conn->pktns.rtb.largest_acked_tx_pkt_num = 0x6afa2f;
+  conn->pktns.tx.last_pkt_num = 0x6afd78;
 
   ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
   spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
                                      NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                     null_data, 126, ++t);
+                                     null_data, 19, 1);
 
   CU_ASSERT(spktlen > 0);
+  CU_ASSERT(pkt_decode_hd_short_mask(&hd, buf, (size_t)spktlen,
+                                     conn->oscid.datalen) > 0);
+  CU_ASSERT(2 == hd.pkt_numlen);
 
-  /* Kick delayed ACK timer */
-  t += NGTCP2_SECONDS;
-
-  conn->pktns.tx.last_pkt_num = 1000000009;
-  conn->pktns.rtb.largest_acked_tx_pkt_num = 1000000007;
-  it = ngtcp2_rtb_head(&conn->pktns.rtb);
-  ngtcp2_conn_detect_lost_pkt(conn, &conn->pktns, &conn->cstat, ++t);
-
-  strm = ngtcp2_conn_find_stream(conn, stream_id);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(1 == strm->tx.loss_count);
+  /* 4 octets pkt num */
+  setup_default_client(&conn);
+  conn->pktns.rtb.largest_acked_tx_pkt_num = 0x6afa2f;
+  conn->pktns.tx.last_pkt_num = 0x6bc106;
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 19, 1);
 
   CU_ASSERT(spktlen > 0);
-  CU_ASSERT(NULL == conn->pktns.tx.frq);
-
-  it = ngtcp2_rtb_head(&conn->pktns.rtb);
-
-  CU_ASSERT(!ngtcp2_ksl_it_end(&it));
+  CU_ASSERT(pkt_decode_hd_short_mask(&hd, buf, (size_t)spktlen,
+                                     conn->oscid.datalen) > 0);
+  CU_ASSERT(3 == hd.pkt_numlen);
 
   ngtcp2_conn_del(conn);
 
-  /* Retransmission takes place per frame basis. */
+  /* 1 octet pkt num (largest)*/
   setup_default_client(&conn);
-  conn->local.bidi.max_streams = 3;
-
-  ngtcp2_conn_open_bidi_stream(conn, &stream_id_a, NULL);
-  ngtcp2_conn_open_bidi_stream(conn, &stream_id_b, NULL);
-
-  ngtcp2_conn_shutdown_stream_write(conn, stream_id_a, NGTCP2_APP_ERR01);
-  ngtcp2_conn_shutdown_stream_write(conn, stream_id_b, NGTCP2_APP_ERR01);
-
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
-
-  CU_ASSERT(spktlen > 0);
-
-  /* Kick delayed ACK timer */
-  t += NGTCP2_SECONDS;
+  conn->pktns.rtb.largest_acked_tx_pkt_num = 1;
+  conn->pktns.tx.last_pkt_num = 128;
 
-  conn->pktns.tx.last_pkt_num = 1000000009;
-  conn->pktns.rtb.largest_acked_tx_pkt_num = 1000000007;
-  it = ngtcp2_rtb_head(&conn->pktns.rtb);
-  ngtcp2_conn_detect_lost_pkt(conn, &conn->pktns, &conn->cstat, ++t);
-  spktlen =
-      ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, (size_t)(spktlen - 1), ++t);
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 19, 1);
 
   CU_ASSERT(spktlen > 0);
-
-  it = ngtcp2_rtb_head(&conn->pktns.rtb);
-
-  CU_ASSERT(!ngtcp2_ksl_it_end(&it));
-  CU_ASSERT(NULL != conn->pktns.tx.frq);
+  CU_ASSERT(pkt_decode_hd_short_mask(&hd, buf, (size_t)spktlen,
+                                     conn->oscid.datalen) > 0);
+  CU_ASSERT(1 == hd.pkt_numlen);
 
   ngtcp2_conn_del(conn);
 
-  /* DATAGRAM frame must not be retransmitted */
+  /* 2 octet pkt num (shortest)*/
   setup_default_client(&conn);
-
-  conn->callbacks.ack_datagram = ack_datagram;
-  conn->remote.transport_params->max_datagram_frame_size = 65535;
+  conn->pktns.rtb.largest_acked_tx_pkt_num = 1;
+  conn->pktns.tx.last_pkt_num = 129;
 
   ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 19, 1);
 
   CU_ASSERT(spktlen > 0);
+  CU_ASSERT(pkt_decode_hd_short_mask(&hd, buf, (size_t)spktlen,
+                                     conn->oscid.datalen) > 0);
+  CU_ASSERT(2 == hd.pkt_numlen);
 
-  fr.type = NGTCP2_FRAME_ACK;
-  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
-  fr.ack.ack_delay = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
-
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
-
-  CU_ASSERT(0 == rv);
+  ngtcp2_conn_del(conn);
 
-  datav.base = null_data;
-  datav.len = 99;
+  /* 2 octet pkt num (largest)*/
+  setup_default_client(&conn);
+  conn->pktns.rtb.largest_acked_tx_pkt_num = 1;
+  conn->pktns.tx.last_pkt_num = 32768;
 
-  spktlen = ngtcp2_conn_writev_datagram(
-      conn, NULL, NULL, buf, sizeof(buf), &accepted,
-      NGTCP2_WRITE_DATAGRAM_FLAG_NONE, 1000000009, &datav, 1, ++t);
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 19, 1);
 
   CU_ASSERT(spktlen > 0);
+  CU_ASSERT(
+      pkt_decode_hd_short(&hd, buf, (size_t)spktlen, conn->oscid.datalen) > 0);
+  CU_ASSERT(2 == hd.pkt_numlen);
 
-  /* Kick delayed ACK timer */
-  t += NGTCP2_SECONDS;
-
-  conn->pktns.tx.last_pkt_num = 1000000009;
-  conn->pktns.rtb.largest_acked_tx_pkt_num = 1000000007;
-  it = ngtcp2_rtb_head(&conn->pktns.rtb);
-  ngtcp2_conn_detect_lost_pkt(conn, &conn->pktns, &conn->cstat, ++t);
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(0 == spktlen);
-  CU_ASSERT(NULL == conn->pktns.tx.frq);
+  /* 3 octet pkt num (shortest) */
+  setup_default_client(&conn);
+  conn->pktns.rtb.largest_acked_tx_pkt_num = 1;
+  conn->pktns.tx.last_pkt_num = 32769;
 
-  it = ngtcp2_rtb_head(&conn->pktns.rtb);
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 19, 1);
 
-  CU_ASSERT(!ngtcp2_ksl_it_end(&it));
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(
+      pkt_decode_hd_short(&hd, buf, (size_t)spktlen, conn->oscid.datalen) > 0);
+  CU_ASSERT(3 == hd.pkt_numlen);
 
   ngtcp2_conn_del(conn);
 
-  /* Retransmit an empty STREAM frame */
+  /* 3 octet pkt num (largest) */
   setup_default_client(&conn);
+  conn->pktns.rtb.largest_acked_tx_pkt_num = 1;
+  conn->pktns.tx.last_pkt_num = 8388608;
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 19, 1);
 
   CU_ASSERT(spktlen > 0);
+  CU_ASSERT(
+      pkt_decode_hd_short(&hd, buf, (size_t)spktlen, conn->oscid.datalen) > 0);
+  CU_ASSERT(3 == hd.pkt_numlen);
 
-  fr.type = NGTCP2_FRAME_ACK;
-  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
-  fr.ack.ack_delay = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
-
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(0 == rv);
+  /* 4 octet pkt num (shortest)*/
+  setup_default_client(&conn);
+  conn->pktns.rtb.largest_acked_tx_pkt_num = 1;
+  conn->pktns.tx.last_pkt_num = 8388609;
 
   ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
   spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
                                      NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                     NULL, 0, ++t);
+                                     null_data, 19, 1);
 
   CU_ASSERT(spktlen > 0);
+  CU_ASSERT(
+      pkt_decode_hd_short(&hd, buf, (size_t)spktlen, conn->oscid.datalen) > 0);
+  CU_ASSERT(4 == hd.pkt_numlen);
 
-  /* Kick delayed ACK timer */
-  t += NGTCP2_SECONDS;
-
-  conn->pktns.tx.last_pkt_num = 1000000009;
-  conn->pktns.rtb.largest_acked_tx_pkt_num = 1000000007;
-  it = ngtcp2_rtb_head(&conn->pktns.rtb);
-  ngtcp2_conn_detect_lost_pkt(conn, &conn->pktns, &conn->cstat, ++t);
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(NULL == conn->pktns.tx.frq);
+  /* Overflow */
+  setup_default_client(&conn);
+  conn->pktns.rtb.largest_acked_tx_pkt_num = 1;
+  conn->pktns.tx.last_pkt_num = NGTCP2_MAX_PKT_NUM - 1;
 
-  it = ngtcp2_rtb_head(&conn->pktns.rtb);
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 19, 1);
 
-  CU_ASSERT(!ngtcp2_ksl_it_end(&it));
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(
+      pkt_decode_hd_short(&hd, buf, (size_t)spktlen, conn->oscid.datalen) > 0);
+  CU_ASSERT(4 == hd.pkt_numlen);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_send_max_stream_data(void) {
+void test_ngtcp2_conn_recv_stateless_reset(void) {
   ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  size_t pktlen;
-  ngtcp2_strm *strm;
-  int64_t pkt_num = 890;
-  ngtcp2_tstamp t = 0;
-  ngtcp2_frame fr;
+  uint8_t buf[256];
+  ngtcp2_ssize spktlen;
   int rv;
-  const uint32_t datalen = 1024;
+  size_t i;
+  uint8_t token[NGTCP2_STATELESS_RESET_TOKENLEN];
 
-  /* MAX_STREAM_DATA should be sent */
+  for (i = 0; i < NGTCP2_STATELESS_RESET_TOKENLEN; ++i) {
+    token[i] = (uint8_t)~i;
+  }
+
+  /* server */
   setup_default_server(&conn);
-  conn->local.transport_params.initial_max_stream_data_bidi_remote = datalen;
+  conn->callbacks.decrypt = fail_decrypt;
+  conn->pktns.rx.max_pkt_num = 24324325;
 
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 0;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = datalen;
-  fr.stream.data[0].base = null_data;
-
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
-
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
-
-  CU_ASSERT(0 == rv);
+  ngtcp2_dcid_set_token(&conn->dcid.current, token);
 
-  rv = ngtcp2_conn_extend_max_stream_offset(conn, 4, datalen);
+  spktlen = ngtcp2_pkt_write_stateless_reset(
+      buf, sizeof(buf), token, null_data, NGTCP2_MIN_STATELESS_RESET_RANDLEN);
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(spktlen > 0);
 
-  strm = ngtcp2_conn_find_stream(conn, 4);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
+                            (size_t)spktlen, 1);
 
-  CU_ASSERT(ngtcp2_strm_is_tx_queued(strm));
+  CU_ASSERT(NGTCP2_ERR_DRAINING == rv);
+  CU_ASSERT(NGTCP2_CS_DRAINING == conn->state);
 
   ngtcp2_conn_del(conn);
 
-  /* MAX_STREAM_DATA should not be sent on incoming fin */
-  setup_default_server(&conn);
-  conn->local.transport_params.initial_max_stream_data_bidi_remote = datalen;
-
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 1;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = datalen;
-  fr.stream.data[0].base = null_data;
-
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
-
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  /* client */
+  setup_default_client(&conn);
+  conn->callbacks.decrypt = fail_decrypt;
+  conn->pktns.rx.max_pkt_num = 3255454;
 
-  CU_ASSERT(0 == rv);
+  ngtcp2_dcid_set_token(&conn->dcid.current, token);
 
-  rv = ngtcp2_conn_extend_max_stream_offset(conn, 4, datalen);
+  spktlen =
+      ngtcp2_pkt_write_stateless_reset(buf, sizeof(buf), token, null_data, 29);
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(spktlen > 0);
 
-  strm = ngtcp2_conn_find_stream(conn, 4);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
+                            (size_t)spktlen, 1);
 
-  CU_ASSERT(!ngtcp2_strm_is_tx_queued(strm));
+  CU_ASSERT(NGTCP2_ERR_DRAINING == rv);
+  CU_ASSERT(NGTCP2_CS_DRAINING == conn->state);
 
   ngtcp2_conn_del(conn);
 
-  /* MAX_STREAM_DATA should not be sent if STOP_SENDING frame is being
-     sent by local endpoint */
+  /* stateless reset in long packet */
   setup_default_server(&conn);
-  conn->local.transport_params.initial_max_stream_data_bidi_remote = datalen;
-
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 0;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = datalen;
-  fr.stream.data[0].base = null_data;
-
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
-
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
-
-  CU_ASSERT(0 == rv);
+  conn->callbacks.decrypt = fail_decrypt;
+  conn->pktns.rx.max_pkt_num = 754233;
 
-  rv = ngtcp2_conn_shutdown_stream_read(conn, 4, NGTCP2_APP_ERR01);
+  ngtcp2_dcid_set_token(&conn->dcid.current, token);
 
-  CU_ASSERT(0 == rv);
+  spktlen = ngtcp2_pkt_write_stateless_reset(
+      buf, sizeof(buf), token, null_data, NGTCP2_MIN_STATELESS_RESET_RANDLEN);
 
-  rv = ngtcp2_conn_extend_max_stream_offset(conn, 4, datalen);
+  CU_ASSERT(spktlen > 0);
 
-  CU_ASSERT(0 == rv);
+  /* long packet */
+  buf[0] |= NGTCP2_HEADER_FORM_BIT;
 
-  strm = ngtcp2_conn_find_stream(conn, 4);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
+                            (size_t)spktlen, 1);
 
-  CU_ASSERT(!ngtcp2_strm_is_tx_queued(strm));
+  CU_ASSERT(NGTCP2_ERR_DRAINING == rv);
+  CU_ASSERT(NGTCP2_CS_DRAINING == conn->state);
 
   ngtcp2_conn_del(conn);
 
-  /* MAX_STREAM_DATA should not be sent if stream is being reset by
-     remote endpoint */
+  /* stateless reset in long packet; parsing long header fails */
   setup_default_server(&conn);
-  conn->local.transport_params.initial_max_stream_data_bidi_remote = datalen;
+  conn->callbacks.decrypt = fail_decrypt;
+  conn->pktns.rx.max_pkt_num = 754233;
 
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 0;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = datalen;
-  fr.stream.data[0].base = null_data;
+  ngtcp2_dcid_set_token(&conn->dcid.current, token);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  spktlen = ngtcp2_pkt_write_stateless_reset(
+      buf, 41, token, null_data, NGTCP2_MIN_STATELESS_RESET_RANDLEN);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  CU_ASSERT(spktlen > 0);
 
-  CU_ASSERT(0 == rv);
+  /* long packet */
+  buf[0] |= NGTCP2_HEADER_FORM_BIT;
+  buf[0] |= 0x30;
+  /* Make version nonzero so that it does not look like Version
+     Negotiation packet */
+  buf[1] = 0xff;
+  /* Make largest CID so that ngtcp2_pkt_decode_hd_long fails */
+  buf[5] = 0xff;
 
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = 4;
-  fr.reset_stream.app_error_code = NGTCP2_APP_ERR01;
-  fr.reset_stream.final_size = datalen;
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
+                            (size_t)spktlen, 1);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  CU_ASSERT(NGTCP2_ERR_DRAINING == rv);
+  CU_ASSERT(NGTCP2_CS_DRAINING == conn->state);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(0 == rv);
+  /* token does not match */
+  setup_default_client(&conn);
+  conn->callbacks.decrypt = fail_decrypt;
+  conn->pktns.rx.max_pkt_num = 24324325;
 
-  rv = ngtcp2_conn_extend_max_stream_offset(conn, 4, datalen);
+  spktlen =
+      ngtcp2_pkt_write_stateless_reset(buf, sizeof(buf), token, null_data, 29);
+
+  CU_ASSERT(spktlen > 0);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
+                            (size_t)spktlen, 1);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(ngtcp2_pq_empty(&conn->tx.strmq));
+  CU_ASSERT(NGTCP2_CS_DRAINING != conn->state);
+  CU_ASSERT(1 == conn->cstat.decrypt_failure_count);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_recv_stream_data(void) {
-  uint8_t buf[1024];
+void test_ngtcp2_conn_recv_retry(void) {
   ngtcp2_conn *conn;
-  my_user_data ud;
-  int64_t pkt_num = 612;
-  ngtcp2_tstamp t = 0;
-  ngtcp2_frame fr;
-  size_t pktlen;
-  int rv;
-  int64_t stream_id;
+  uint8_t buf[2048];
+  ngtcp2_ssize spktlen;
+  uint64_t t = 0;
+  ngtcp2_cid dcid;
+  const uint8_t token[] = "address-validation-token";
   size_t i;
+  int64_t stream_id;
+  ngtcp2_ssize datalen;
+  int rv;
+  ngtcp2_vec datav;
+  ngtcp2_strm *strm;
+  ngtcp2_crypto_aead aead = {0};
+  ngtcp2_crypto_aead_ctx aead_ctx = {0};
 
-  /* 2 STREAM frames are received in the correct order. */
-  setup_default_server(&conn);
-  conn->callbacks.recv_stream_data = recv_stream_data;
-  conn->user_data = &ud;
+  dcid_init(&dcid);
+  setup_handshake_client(&conn);
+  conn->callbacks.recv_retry = recv_retry;
 
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 0;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 111;
-  fr.stream.data[0].base = null_data;
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  CU_ASSERT(spktlen > 0);
 
-  memset(&ud, 0, sizeof(ud));
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  spktlen = ngtcp2_pkt_write_retry(
+      buf, sizeof(buf), NGTCP2_PROTO_VER_V1, &conn->oscid, &dcid,
+      ngtcp2_conn_get_dcid(conn), token, strsize(token), null_encrypt, &aead,
+      &aead_ctx);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(4 == ud.stream_data.stream_id);
-  CU_ASSERT(!(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN));
-  CU_ASSERT(!(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_EARLY));
-  CU_ASSERT(111 == ud.stream_data.datalen);
+  CU_ASSERT(spktlen > 0);
 
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 1;
-  fr.stream.offset = 111;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 99;
-  fr.stream.data[0].base = null_data;
+  for (i = 0; i < 2; ++i) {
+    rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
+                              (size_t)spktlen, ++t);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+    CU_ASSERT(0 == rv);
 
-  memset(&ud, 0, sizeof(ud));
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+    spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(4 == ud.stream_data.stream_id);
-  CU_ASSERT(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN);
-  CU_ASSERT(99 == ud.stream_data.datalen);
+    if (i == 1) {
+      /* Retry packet was ignored */
+      CU_ASSERT(spktlen == 0);
+    } else {
+      CU_ASSERT(spktlen > 0);
+      CU_ASSERT(1 == conn->in_pktns->tx.last_pkt_num);
+      CU_ASSERT(ngtcp2_cid_eq(&dcid, ngtcp2_conn_get_dcid(conn)));
+      CU_ASSERT(conn->flags & NGTCP2_CONN_FLAG_RECV_RETRY);
+    }
+  }
 
   ngtcp2_conn_del(conn);
 
-  /* 2 STREAM frames are received in the correct order, and 2nd STREAM
-     frame has 0 length, and FIN bit set. */
-  setup_default_server(&conn);
-  conn->callbacks.recv_stream_data = recv_stream_data;
-  conn->user_data = &ud;
+  /* Retry packet with non-matching tag is rejected */
+  setup_handshake_client(&conn);
+  conn->callbacks.recv_retry = recv_retry;
 
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 0;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 111;
-  fr.stream.data[0].base = null_data;
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  CU_ASSERT(spktlen > 0);
 
-  memset(&ud, 0, sizeof(ud));
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  spktlen = ngtcp2_pkt_write_retry(
+      buf, sizeof(buf), NGTCP2_PROTO_VER_V1, &conn->oscid, &dcid,
+      ngtcp2_conn_get_dcid(conn), token, strsize(token), null_encrypt, &aead,
+      &aead_ctx);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(4 == ud.stream_data.stream_id);
-  CU_ASSERT(!(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN));
-  CU_ASSERT(111 == ud.stream_data.datalen);
-
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 1;
-  fr.stream.offset = 111;
-  fr.stream.datacnt = 0;
+  CU_ASSERT(spktlen > 0);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  /* Change tag */
+  buf[spktlen - 1] = 1;
 
-  memset(&ud, 0, sizeof(ud));
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
+                            (size_t)spktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(4 == ud.stream_data.stream_id);
-  CU_ASSERT(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN);
-  CU_ASSERT(0 == ud.stream_data.datalen);
 
-  ngtcp2_conn_del(conn);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  /* 2 identical STREAM frames with FIN bit set are received.  The
-     recv_stream_data callback should not be called for sencond STREAM
-     frame. */
-  setup_default_server(&conn);
-  conn->callbacks.recv_stream_data = recv_stream_data;
-  conn->user_data = &ud;
+  CU_ASSERT(0 == spktlen);
 
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 1;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 111;
-  fr.stream.data[0].base = null_data;
+  ngtcp2_conn_del(conn);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  /* Make sure that 0RTT packets are retransmitted */
+  setup_early_client(&conn);
+  conn->callbacks.recv_retry = recv_retry;
 
-  memset(&ud, 0, sizeof(ud));
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(4 == ud.stream_data.stream_id);
-  CU_ASSERT(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN);
-  CU_ASSERT(111 == ud.stream_data.datalen);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  spktlen =
+      ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, sizeof(buf), &datalen,
+                                NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                null_datav(&datav, 219), 1, ++t);
 
-  memset(&ud, 0, sizeof(ud));
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  CU_ASSERT(sizeof(buf) == spktlen);
+  CU_ASSERT(219 == datalen);
+
+  spktlen =
+      ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, sizeof(buf), &datalen,
+                                NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                null_datav(&datav, 119), 1, ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(119 == datalen);
+
+  spktlen = ngtcp2_pkt_write_retry(
+      buf, sizeof(buf), NGTCP2_PROTO_VER_V1, &conn->oscid, &dcid,
+      ngtcp2_conn_get_dcid(conn), token, strsize(token), null_encrypt, &aead,
+      &aead_ctx);
+
+  CU_ASSERT(spktlen > 0);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
+                            (size_t)spktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(0 == ud.stream_data.stream_id);
-  CU_ASSERT(!(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN));
-  CU_ASSERT(0 == ud.stream_data.datalen);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  /* Make sure that resent 0RTT packet is padded */
+  CU_ASSERT(sizeof(buf) == spktlen);
+  CU_ASSERT(2 == conn->pktns.tx.last_pkt_num);
+
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
+
+  CU_ASSERT(0 == ngtcp2_ksl_len(strm->tx.streamfrq));
+
+  /* ngtcp2_conn_write_stream sends new 0RTT packet. */
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &datalen, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, null_data, 120, ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(3 == conn->pktns.tx.last_pkt_num);
+  CU_ASSERT(120 == datalen);
+  CU_ASSERT(NULL == conn->pktns.tx.frq);
+  CU_ASSERT(!ngtcp2_rtb_empty(&conn->pktns.rtb));
 
   ngtcp2_conn_del(conn);
+}
 
-  /* Re-ordered STREAM frame; we first gets 0 length STREAM frame with
-     FIN bit set. Then the remaining STREAM frame is received. */
-  setup_default_server(&conn);
-  conn->callbacks.recv_stream_data = recv_stream_data;
-  conn->user_data = &ud;
+void test_ngtcp2_conn_recv_delayed_handshake_pkt(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_frame fr;
+  int rv;
 
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 1;
-  fr.stream.offset = 599;
-  fr.stream.datacnt = 0;
+  setup_default_client(&conn);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 567;
+  fr.crypto.data[0].base = null_data;
 
-  memset(&ud, 0, sizeof(ud));
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_HANDSHAKE, &conn->oscid,
+      ngtcp2_conn_get_dcid(conn), 1, NGTCP2_PROTO_VER_V1, &fr, &null_ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(0 == ud.stream_data.stream_id);
+  CU_ASSERT(1 == ngtcp2_acktr_len(&conn->hs_pktns->acktr));
 
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 0;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 599;
-  fr.stream.data[0].base = null_data;
+  ngtcp2_conn_del(conn);
+}
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+void test_ngtcp2_conn_recv_max_streams(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  int rv;
+  ngtcp2_frame fr;
 
-  memset(&ud, 0, sizeof(ud));
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  setup_default_client(&conn);
+
+  fr.type = NGTCP2_FRAME_MAX_STREAMS_UNI;
+  fr.max_streams.max_streams = 999;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(4 == ud.stream_data.stream_id);
-  CU_ASSERT(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN);
-  CU_ASSERT(599 == ud.stream_data.datalen);
+  CU_ASSERT(999 == conn->local.uni.max_streams);
+
+  fr.type = NGTCP2_FRAME_MAX_STREAMS_BIDI;
+  fr.max_streams.max_streams = 997;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(997 == conn->local.bidi.max_streams);
 
   ngtcp2_conn_del(conn);
+}
 
-  /* Simulate the case where packet is lost.  We first gets 0 length
-     STREAM frame with FIN bit set.  Then the lost STREAM frame is
-     retransmitted with FIN bit set is received. */
-  setup_default_server(&conn);
-  conn->callbacks.recv_stream_data = recv_stream_data;
-  conn->user_data = &ud;
+void test_ngtcp2_conn_auto_max_streams(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_settings settings;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_ssize spktlen;
+  int rv;
+  ngtcp2_frame fr;
+  int64_t pkt_num = 0;
+  ngtcp2_tstamp t = 0;
+  int64_t i;
 
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 1;
-  fr.stream.offset = 599;
-  fr.stream.datacnt = 0;
+  server_default_settings(&settings);
+  settings.auto_max_streams = 1;
+  settings.max_streams_window = 12;
+
+  setup_default_server_settings(&conn, &settings);
+  conn->remote.uni.unsent_max_streams = conn->remote.uni.max_streams =
+      conn->remote.uni.window = 8;
+
+  /* Closing remote streams extends the limit, but MAX_STREAMS is
+     held back until the extension reaches the half of the window. */
+  for (i = 0; i < 4; ++i) {
+    fr.type = NGTCP2_FRAME_STREAM;
+    fr.stream.flags = 0;
+    fr.stream.stream_id = 2 + i * 4;
+    fr.stream.fin = 1;
+    fr.stream.offset = 0;
+    fr.stream.datacnt = 1;
+    fr.stream.data[0].len = 1;
+    fr.stream.data[0].base = null_data;
+
+    pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                    &fr, conn->pktns.crypto.rx.ckm);
+    rv =
+        ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+    CU_ASSERT(0 == rv);
+    CU_ASSERT(NULL == ngtcp2_conn_find_stream(conn, fr.stream.stream_id));
+    CU_ASSERT(9 + (uint64_t)i == conn->remote.uni.unsent_max_streams);
+
+    spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+    CU_ASSERT(spktlen >= 0);
+
+    if (i < 3) {
+      CU_ASSERT(8 == conn->remote.uni.max_streams);
+    } else {
+      CU_ASSERT(12 == conn->remote.uni.max_streams);
+    }
+  }
+
+  /* STREAMS_BLOCKED doubles the window up to max_streams_window, and
+     sends MAX_STREAMS immediately. */
+  fr.type = NGTCP2_FRAME_STREAMS_BLOCKED_UNI;
+  fr.streams_blocked.max_streams = 12;
 
   pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
                                   &fr, conn->pktns.crypto.rx.ckm);
-
-  memset(&ud, 0, sizeof(ud));
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(0 == ud.stream_data.stream_id);
+  CU_ASSERT(12 == conn->remote.uni.window);
+  CU_ASSERT(16 == conn->remote.uni.unsent_max_streams);
+  CU_ASSERT(conn->remote.uni.blocked);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(16 == conn->remote.uni.max_streams);
+  CU_ASSERT(!conn->remote.uni.blocked);
 
+  /* The window does not grow beyond max_streams_window, but a stalled
+     extension is flushed. */
   fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 4;
+  fr.stream.flags = 0;
+  fr.stream.stream_id = 18;
   fr.stream.fin = 1;
   fr.stream.offset = 0;
   fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 599;
+  fr.stream.data[0].len = 1;
   fr.stream.data[0].base = null_data;
 
   pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
                                   &fr, conn->pktns.crypto.rx.ckm);
-
-  memset(&ud, 0, sizeof(ud));
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(4 == ud.stream_data.stream_id);
-  CU_ASSERT(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN);
-  CU_ASSERT(599 == ud.stream_data.datalen);
+  CU_ASSERT(17 == conn->remote.uni.unsent_max_streams);
 
-  ngtcp2_conn_del(conn);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  /* Receive an unidirectional stream data */
-  setup_default_client(&conn);
-  conn->callbacks.recv_stream_data = recv_stream_data;
-  conn->user_data = &ud;
+  CU_ASSERT(spktlen >= 0);
+  CU_ASSERT(16 == conn->remote.uni.max_streams);
 
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 3;
-  fr.stream.fin = 0;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 911;
-  fr.stream.data[0].base = null_data;
+  fr.type = NGTCP2_FRAME_STREAMS_BLOCKED_UNI;
+  fr.streams_blocked.max_streams = 16;
 
   pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
                                   &fr, conn->pktns.crypto.rx.ckm);
-
-  memset(&ud, 0, sizeof(ud));
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(3 == ud.stream_data.stream_id);
-  CU_ASSERT(!(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN));
-  CU_ASSERT(911 == ud.stream_data.datalen);
+  CU_ASSERT(12 == conn->remote.uni.window);
+  CU_ASSERT(17 == conn->remote.uni.unsent_max_streams);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(17 == conn->remote.uni.max_streams);
 
   ngtcp2_conn_del(conn);
 
-  /* Receive an unidirectional stream which is beyond the limit. */
+  /* Without auto_max_streams, closing a stream does not extend the
+     limit. */
   setup_default_server(&conn);
-  conn->callbacks.recv_stream_data = recv_stream_data;
-  conn->remote.uni.max_streams = 0;
-  conn->user_data = &ud;
 
   fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.flags = 0;
   fr.stream.stream_id = 2;
-  fr.stream.fin = 0;
+  fr.stream.fin = 1;
   fr.stream.offset = 0;
   fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 911;
+  fr.stream.data[0].len = 1;
   fr.stream.data[0].base = null_data;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
-
-  memset(&ud, 0, sizeof(ud));
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 1);
 
-  CU_ASSERT(NGTCP2_ERR_STREAM_LIMIT == rv);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL == ngtcp2_conn_find_stream(conn, 2));
+  CU_ASSERT(conn->remote.uni.max_streams ==
+            conn->remote.uni.unsent_max_streams);
 
   ngtcp2_conn_del(conn);
+}
 
-  /* Receiving nonzero payload for an local unidirectional stream is a
-     protocol violation. */
-  setup_default_client(&conn);
-
-  rv = ngtcp2_conn_open_uni_stream(conn, &stream_id, NULL);
+void test_ngtcp2_conn_handshake(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_ssize spktlen;
+  ngtcp2_frame fr;
+  int64_t pkt_num = 12345689;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_cid rcid;
+  int rv;
+  int64_t stream_id;
+  ngtcp2_ssize nwrite;
+  ngtcp2_crypto_aead_ctx aead_ctx = {0};
+  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
+  ngtcp2_crypto_ctx crypto_ctx;
 
-  CU_ASSERT(0 == rv);
+  rcid_init(&rcid);
 
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = stream_id;
-  fr.stream.fin = 0;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 9;
-  fr.stream.data[0].base = null_data;
+  /* Make sure server Initial is padded */
+  setup_handshake_server(&conn);
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 1200;
+  fr.crypto.data[0].base = null_data;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid, ngtcp2_conn_get_dcid(conn),
+      ++pkt_num, conn->client_chosen_version, &fr, &null_ckm);
 
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(NGTCP2_ERR_STREAM_STATE == rv);
+  CU_ASSERT(0 == rv);
 
-  ngtcp2_conn_del(conn);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  /* DATA on crypto stream, and TLS alert is generated. */
-  setup_default_server(&conn);
-  conn->callbacks.recv_crypto_data = recv_crypto_fatal_alert_generated;
+  CU_ASSERT(spktlen >= 1200);
+  CU_ASSERT(1 == conn->cstat.handshake_datagrams_sent);
+
+  ngtcp2_conn_del(conn);
 
+  /* Make sure server Handshake is padded when ack-eliciting Initial
+     is coalesced. */
+  setup_handshake_server(&conn);
   fr.type = NGTCP2_FRAME_CRYPTO;
   fr.crypto.offset = 0;
   fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 139;
+  fr.crypto.data[0].len = 1200;
   fr.crypto.data[0].base = null_data;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid, ngtcp2_conn_get_dcid(conn),
+      ++pkt_num, conn->client_chosen_version, &fr, &null_ckm);
 
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(NGTCP2_ERR_CRYPTO == rv);
-
-  ngtcp2_conn_del(conn);
-
-  /* 0 length STREAM frame is allowed */
-  setup_default_server(&conn);
-
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 0;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 0;
+  CU_ASSERT(0 == rv);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  ngtcp2_conn_submit_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_HANDSHAKE, null_data,
+                                 91);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 4));
+  CU_ASSERT(spktlen >= 1200);
+  CU_ASSERT(1 == conn->hs_pktns->rtb.ents.len);
+  CU_ASSERT(1 == conn->cstat.handshake_datagrams_sent);
 
   ngtcp2_conn_del(conn);
 
-  /* After sending STOP_SENDING, receiving 2 STREAM frames with fin
-     bit set must not invoke recv_stream_data callback. */
-  setup_default_server(&conn);
-  conn->callbacks.recv_stream_data = recv_stream_data;
-  conn->user_data = &ud;
-
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 0;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 0;
+  /* Make sure that client packet is padded if it includes Initial and
+     0RTT packets */
+  setup_early_client(&conn);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  conn->callbacks.client_initial = client_initial_large_crypto_early_data;
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 4));
 
-  rv = ngtcp2_conn_shutdown_stream_read(conn, 4, 99);
+  /* First packet should only includes Initial.  No space for 0RTT. */
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, 1280, &nwrite,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 10, ++t);
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(1280 == spktlen);
+  CU_ASSERT(-1 == nwrite);
 
-  for (i = 0; i < 2; ++i) {
-    fr.type = NGTCP2_FRAME_STREAM;
-    fr.stream.stream_id = 4;
-    fr.stream.fin = 1;
-    fr.stream.offset = 0;
-    fr.stream.datacnt = 1;
-    fr.stream.data[0].base = null_data;
-    fr.stream.data[0].len = 19;
+  /* Second packet has a room for 0RTT. */
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, 1280, &nwrite,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 10, ++t);
 
-    pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                    &fr, conn->pktns.crypto.rx.ckm);
+  CU_ASSERT(1280 == spktlen);
+  CU_ASSERT(10 == nwrite);
 
-    ud.stream_data.stream_id = 0;
-    rv =
-        ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  /* We have no data to send. */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, 1280, ++t);
 
-    CU_ASSERT(0 == rv);
-    CU_ASSERT(0 == ud.stream_data.stream_id);
-    CU_ASSERT(19 == conn->rx.offset);
-    CU_ASSERT(19 == conn->rx.unsent_max_offset -
-                        conn->local.transport_params.initial_max_data);
-    CU_ASSERT(conn->local.transport_params.initial_max_data ==
-              conn->rx.max_offset);
-  }
+  CU_ASSERT(0 == spktlen);
 
   ngtcp2_conn_del(conn);
 
-  /* After receiving RESET_STREAM, recv_stream_data callback must not
-     be invoked */
-  setup_default_server(&conn);
-  conn->callbacks.recv_stream_data = recv_stream_data;
-  conn->user_data = &ud;
+  /* Make sure that client non ack-eliciting Initial triggers
+     padding. */
+  setup_handshake_client(&conn);
 
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 0;
-  fr.stream.fin = 0;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 0;
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  CU_ASSERT(spktlen >= 1200);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 0));
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 1200;
+  fr.crypto.data[0].base = null_data;
 
-  fr.type = NGTCP2_FRAME_RESET_STREAM;
-  fr.reset_stream.stream_id = 0;
-  fr.reset_stream.app_error_code = 999;
-  fr.reset_stream.final_size = 199;
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
+      ngtcp2_conn_get_dcid(conn), ++pkt_num, conn->client_chosen_version, &fr,
+      &null_ckm);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 0));
-  CU_ASSERT(199 == conn->rx.unsent_max_offset -
-                       conn->local.transport_params.initial_max_data);
 
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 0;
-  fr.stream.fin = 0;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].base = null_data;
-  fr.stream.data[0].len = 198;
+  init_crypto_ctx(&crypto_ctx);
+  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
+  ngtcp2_conn_install_rx_handshake_key(conn, &aead_ctx, null_iv,
+                                       sizeof(null_iv), &hp_ctx);
+  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
+                                       sizeof(null_iv), &hp_ctx);
+
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_HANDSHAKE, &conn->oscid,
+      ngtcp2_conn_get_dcid(conn), ++pkt_num, conn->client_chosen_version, &fr,
+      &null_ckm);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
-  ud.stream_data.stream_id = -1;
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(-1 == ud.stream_data.stream_id);
-  CU_ASSERT(199 == conn->rx.unsent_max_offset -
-                       conn->local.transport_params.initial_max_data);
-
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 0;
-  fr.stream.fin = 1;
-  fr.stream.offset = 198;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].base = null_data;
-  fr.stream.data[0].len = 1;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
-  ud.stream_data.stream_id = -1;
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(-1 == ud.stream_data.stream_id);
-  CU_ASSERT(199 == conn->rx.unsent_max_offset -
-                       conn->local.transport_params.initial_max_data);
+  CU_ASSERT(spktlen >= 1200);
 
   ngtcp2_conn_del(conn);
+}
 
-  /* ngtcp2_conn_shutdown_stream_read is called in recv_stream_data
-     callback.  Further recv_stream_data callback must not be
-     called. */
-  setup_default_server(&conn);
-  conn->callbacks.recv_stream_data = recv_stream_data_shutdown_stream_read;
-  conn->user_data = &ud;
-
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 0;
-  fr.stream.offset = 599;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 1;
-  fr.stream.data[0].base = null_data;
+void test_ngtcp2_conn_handshake_error(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_ssize spktlen;
+  ngtcp2_frame fr;
+  int64_t pkt_num = 107;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_cid rcid;
+  int rv;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  rcid_init(&rcid);
+
+  /* client side */
+  setup_handshake_client(&conn);
+  conn->callbacks.recv_crypto_data = recv_crypto_handshake_error;
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 333;
+  fr.crypto.data[0].base = null_data;
+
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
+      ngtcp2_conn_get_dcid(conn), ++pkt_num, conn->client_chosen_version, &fr,
+      &null_ckm);
 
-  memset(&ud, 0, sizeof(ud));
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(0 == ud.stream_data.stream_id);
+  CU_ASSERT(NGTCP2_ERR_CRYPTO == rv);
 
-  fr.type = NGTCP2_FRAME_STREAM;
-  fr.stream.stream_id = 4;
-  fr.stream.fin = 0;
-  fr.stream.offset = 0;
-  fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 599;
-  fr.stream.data[0].base = null_data;
+  ngtcp2_conn_del(conn);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  /* server side */
+  setup_handshake_server(&conn);
+  conn->callbacks.recv_crypto_data = recv_crypto_handshake_error;
+
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 1200;
+  fr.crypto.data[0].base = null_data;
+
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid, ngtcp2_conn_get_dcid(conn),
+      ++pkt_num, conn->client_chosen_version, &fr, &null_ckm);
 
-  memset(&ud, 0, sizeof(ud));
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(4 == ud.stream_data.stream_id);
-  CU_ASSERT(!(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN));
-  CU_ASSERT(599 == ud.stream_data.datalen);
+  CU_ASSERT(NGTCP2_ERR_CRYPTO == rv);
 
   ngtcp2_conn_del(conn);
-}
 
-void test_ngtcp2_conn_recv_ping(void) {
-  uint8_t buf[1024];
-  ngtcp2_conn *conn;
-  int64_t pkt_num = 133;
-  ngtcp2_tstamp t = 0;
-  ngtcp2_frame fr;
-  size_t pktlen;
-  int rv;
+  /* server side; wrong version */
+  setup_handshake_server(&conn);
+  conn->callbacks.recv_crypto_data = recv_crypto_handshake_error;
 
-  setup_default_client(&conn);
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 1201;
+  fr.crypto.data[0].base = null_data;
 
-  fr.type = NGTCP2_FRAME_PING;
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid, ngtcp2_conn_get_dcid(conn),
+      ++pkt_num, 0xffff, &fr, &null_ckm);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL == conn->pktns.tx.frq);
+  CU_ASSERT(NGTCP2_ERR_DROP_CONN == rv);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_recv_max_stream_data(void) {
-  uint8_t buf[1024];
+void test_ngtcp2_conn_retransmit_first(void) {
   ngtcp2_conn *conn;
-  int64_t pkt_num = 1000000007;
+  uint8_t buf[1200];
+  ngtcp2_ssize spktlen;
   ngtcp2_tstamp t = 0;
-  ngtcp2_frame fr;
-  size_t pktlen;
+  int64_t stream_id;
+  ngtcp2_rtb_it it;
+  ngtcp2_rtb_entry *ent;
+  ngtcp2_frame_chain *frc;
+  ngtcp2_vec datav = {null_data, 800};
+  size_t i;
   int rv;
-  ngtcp2_strm *strm;
 
-  /* Receiving MAX_STREAM_DATA to an uninitiated local bidirectional
-     stream ID is an error */
-  setup_default_client(&conn);
+  for (i = 0; i < 2; ++i) {
+    setup_default_client(&conn);
+    conn->local.settings.retransmit_first = (int)i;
+    conn->remote.transport_params->max_datagram_frame_size = 65535;
 
-  fr.type = NGTCP2_FRAME_MAX_STREAM_DATA;
-  fr.max_stream_data.stream_id = 4;
-  fr.max_stream_data.max_stream_data = 8092;
+    ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+    spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                       NULL, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                       stream_id, null_data, 200, ++t);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+    CU_ASSERT(spktlen > 0);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+    /* Kick delayed ACK timer */
+    t += NGTCP2_SECONDS;
 
-  CU_ASSERT(NGTCP2_ERR_STREAM_STATE == rv);
+    conn->pktns.tx.last_pkt_num = 1000000009;
+    conn->pktns.rtb.largest_acked_tx_pkt_num = 1000000007;
+    ngtcp2_conn_detect_lost_pkt(conn, &conn->pktns, &conn->cstat, ++t);
 
-  ngtcp2_conn_del(conn);
+    CU_ASSERT(1 == conn->tx.strmq_nretrans);
 
-  /* Receiving MAX_STREAM_DATA to an uninitiated local unidirectional
-     stream ID is an error */
-  setup_default_client(&conn);
+    rv = ngtcp2_conn_enqueue_datagram(conn, 1, &datav, 1, UINT64_MAX);
 
-  fr.type = NGTCP2_FRAME_MAX_STREAM_DATA;
-  fr.max_stream_data.stream_id = 2;
-  fr.max_stream_data.max_stream_data = 8092;
+    CU_ASSERT(0 == rv);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+    spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+    CU_ASSERT(spktlen > 0);
 
-  CU_ASSERT(NGTCP2_ERR_STREAM_STATE == rv);
+    it = ngtcp2_rtb_head(&conn->pktns.rtb);
+    ent = ngtcp2_rtb_it_get(&it);
+
+    for (frc = ent->frc; frc && frc->fr.type != NGTCP2_FRAME_STREAM;
+         frc = frc->next)
+      ;
+
+    /* The lost packet also carried NEW_CONNECTION_ID frames, which
+       are retransmitted ahead of both. */
+    if (i == 0) {
+      /* The queued DATAGRAM goes first, and only a part of the lost
+         stream data fits in the rest of the packet. */
+      CU_ASSERT(ent->flags & NGTCP2_RTB_ENTRY_FLAG_DATAGRAM);
+      CU_ASSERT(1 == conn->tx.strmq_nretrans);
+      CU_ASSERT(0 == ngtcp2_conn_get_datagram_queue_len(conn));
+    } else {
+      /* The lost stream data go first, and the DATAGRAM which does
+         not fit waits for the next packet. */
+      CU_ASSERT(!(ent->flags & NGTCP2_RTB_ENTRY_FLAG_DATAGRAM));
+      CU_ASSERT(NULL != frc);
+      CU_ASSERT(0 == frc->fr.stream.offset);
+      CU_ASSERT(0 == conn->tx.strmq_nretrans);
+      CU_ASSERT(1 == ngtcp2_conn_get_datagram_queue_len(conn));
 
-  ngtcp2_conn_del(conn);
+      spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  /* Receiving MAX_STREAM_DATA to a remote bidirectional stream which
-     exceeds limit */
-  setup_default_client(&conn);
+      CU_ASSERT(spktlen > 0);
+      CU_ASSERT(0 == ngtcp2_conn_get_datagram_queue_len(conn));
 
-  fr.type = NGTCP2_FRAME_MAX_STREAM_DATA;
-  fr.max_stream_data.stream_id = 1;
-  fr.max_stream_data.max_stream_data = 1000000009;
+      it = ngtcp2_rtb_head(&conn->pktns.rtb);
+      ent = ngtcp2_rtb_it_get(&it);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+      CU_ASSERT(ent->flags & NGTCP2_RTB_ENTRY_FLAG_DATAGRAM);
+    }
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+    ngtcp2_conn_del(conn);
+  }
+}
 
-  CU_ASSERT(NGTCP2_ERR_STREAM_LIMIT == rv);
+void test_ngtcp2_conn_retransmit_protected(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  ngtcp2_ssize spktlen;
+  ngtcp2_tstamp t = 0;
+  int64_t stream_id, stream_id_a, stream_id_b;
+  ngtcp2_rtb_it it;
+  ngtcp2_frame fr;
+  size_t pktlen;
+  ngtcp2_vec datav;
+  int accepted;
+  int rv;
+  ngtcp2_strm *strm;
 
-  ngtcp2_conn_del(conn);
+  /* Retransmit a packet completely */
+  setup_default_client(&conn);
 
-  /* Receiving MAX_STREAM_DATA to a remote bidirectional stream which
-     the local endpoint has not received yet. */
-  setup_default_server(&conn);
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 126, ++t);
 
-  fr.type = NGTCP2_FRAME_MAX_STREAM_DATA;
-  fr.max_stream_data.stream_id = 4;
-  fr.max_stream_data.max_stream_data = 1000000009;
+  CU_ASSERT(spktlen > 0);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  /* Kick delayed ACK timer */
+  t += NGTCP2_SECONDS;
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  conn->pktns.tx.last_pkt_num = 1000000009;
+  conn->pktns.rtb.largest_acked_tx_pkt_num = 1000000007;
+  it = ngtcp2_rtb_head(&conn->pktns.rtb);
+  ngtcp2_conn_detect_lost_pkt(conn, &conn->pktns, &conn->cstat, ++t);
 
-  CU_ASSERT(0 == rv);
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
 
-  strm = ngtcp2_conn_find_stream(conn, 4);
+  CU_ASSERT(1 == strm->tx.loss_count);
+  CU_ASSERT(1 == conn->cstat.lost_pkt_count);
 
-  CU_ASSERT(NULL != strm);
-  CU_ASSERT(1000000009 == strm->tx.max_offset);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  ngtcp2_conn_del(conn);
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(NULL == conn->pktns.tx.frq);
 
-  /* Receiving MAX_STREAM_DATA to a idle remote unidirectional stream
-     is a protocol violation. */
-  setup_default_server(&conn);
+  it = ngtcp2_rtb_head(&conn->pktns.rtb);
 
-  fr.type = NGTCP2_FRAME_MAX_STREAM_DATA;
-  fr.max_stream_data.stream_id = 2;
-  fr.max_stream_data.max_stream_data = 1000000009;
+  CU_ASSERT(!ngtcp2_rtb_it_end(&it));
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  ngtcp2_conn_del(conn);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  /* Retransmission takes place per frame basis. */
+  setup_default_client(&conn);
+  conn->local.bidi.max_streams = 3;
 
-  CU_ASSERT(NGTCP2_ERR_STREAM_STATE == rv);
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id_a, NULL);
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id_b, NULL);
 
-  ngtcp2_conn_del(conn);
+  ngtcp2_conn_shutdown_stream_write(conn, stream_id_a, NGTCP2_APP_ERR01);
+  ngtcp2_conn_shutdown_stream_write(conn, stream_id_b, NGTCP2_APP_ERR01);
 
-  /* Receiving MAX_STREAM_DATA to an existing bidirectional stream */
-  setup_default_server(&conn);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  strm = open_stream(conn, 4);
+  CU_ASSERT(spktlen > 0);
 
-  fr.type = NGTCP2_FRAME_MAX_STREAM_DATA;
-  fr.max_stream_data.stream_id = 4;
-  fr.max_stream_data.max_stream_data = 1000000009;
+  /* Kick delayed ACK timer */
+  t += NGTCP2_SECONDS;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  conn->pktns.tx.last_pkt_num = 1000000009;
+  conn->pktns.rtb.largest_acked_tx_pkt_num = 1000000007;
+  it = ngtcp2_rtb_head(&conn->pktns.rtb);
+  ngtcp2_conn_detect_lost_pkt(conn, &conn->pktns, &conn->cstat, ++t);
+  spktlen =
+      ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, (size_t)(spktlen - 1), ++t);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  CU_ASSERT(spktlen > 0);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(1000000009 == strm->tx.max_offset);
+  it = ngtcp2_rtb_head(&conn->pktns.rtb);
+
+  CU_ASSERT(!ngtcp2_rtb_it_end(&it));
+  CU_ASSERT(NULL != conn->pktns.tx.frq);
 
   ngtcp2_conn_del(conn);
-}
 
-void test_ngtcp2_conn_send_early_data(void) {
-  ngtcp2_conn *conn;
-  ngtcp2_ssize spktlen;
-  ngtcp2_ssize datalen;
-  uint8_t buf[1024];
-  int64_t stream_id;
-  int rv;
-  ngtcp2_tstamp t = 0;
-  ngtcp2_vec datav;
+  /* DATAGRAM frame must not be retransmitted */
+  setup_default_client(&conn);
 
-  setup_early_client(&conn);
+  conn->callbacks.ack_datagram = ack_datagram;
+  conn->remote.transport_params->max_datagram_frame_size = 65535;
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(spktlen > 0);
 
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
-                                     &datalen, NGTCP2_WRITE_STREAM_FLAG_FIN,
-                                     stream_id, null_data, 1024, ++t);
-
-  CU_ASSERT((ngtcp2_ssize)sizeof(buf) == spktlen);
-  CU_ASSERT(670 == datalen);
-
-  ngtcp2_conn_del(conn);
-
-  /* Verify that Handshake packet and 0-RTT packet are coalesced into
-     one UDP packet. */
-  setup_early_client(&conn);
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
 
-  spktlen =
-      ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, sizeof(buf), &datalen,
-                                NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                null_datav(&datav, 199), 1, ++t);
+  datav.base = null_data;
+  datav.len = 99;
 
-  CU_ASSERT(sizeof(buf) == spktlen);
-  CU_ASSERT(199 == datalen);
+  spktlen = ngtcp2_conn_writev_datagram(
+      conn, NULL, NULL, buf, sizeof(buf), &accepted,
+      NGTCP2_WRITE_DATAGRAM_FLAG_NONE, 1000000009, &datav, 1, ++t);
 
-  ngtcp2_conn_del(conn);
+  CU_ASSERT(spktlen > 0);
 
-  /* 0 length 0-RTT packet with FIN bit set */
-  setup_early_client(&conn);
+  /* Kick delayed ACK timer */
+  t += NGTCP2_SECONDS;
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  conn->pktns.tx.last_pkt_num = 1000000009;
+  conn->pktns.rtb.largest_acked_tx_pkt_num = 1000000007;
+  it = ngtcp2_rtb_head(&conn->pktns.rtb);
+  ngtcp2_conn_detect_lost_pkt(conn, &conn->pktns, &conn->cstat, ++t);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == spktlen);
+  CU_ASSERT(NULL == conn->pktns.tx.frq);
 
-  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, sizeof(buf),
-                                      &datalen, NGTCP2_WRITE_STREAM_FLAG_FIN,
-                                      stream_id, NULL, 0, ++t);
+  it = ngtcp2_rtb_head(&conn->pktns.rtb);
 
-  CU_ASSERT(sizeof(buf) == spktlen);
-  CU_ASSERT(0 == datalen);
+  CU_ASSERT(!ngtcp2_rtb_it_end(&it));
 
   ngtcp2_conn_del(conn);
 
-  /* Can write 0 length STREAM frame */
-  setup_early_client(&conn);
-
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
-
-  CU_ASSERT(0 == rv);
+  /* Retransmit an empty STREAM frame */
+  setup_default_client(&conn);
 
-  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, sizeof(buf),
-                                      &datalen, NGTCP2_WRITE_STREAM_FLAG_NONE,
-                                      -1, NULL, 0, ++t);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
   CU_ASSERT(spktlen > 0);
 
-  /* We have written Initial.  Now check that STREAM frame is
-     written. */
-  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, sizeof(buf),
-                                      &datalen, NGTCP2_WRITE_STREAM_FLAG_NONE,
-                                      stream_id, NULL, 0, ++t);
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
 
-  CU_ASSERT(spktlen > 0);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  ngtcp2_conn_del(conn);
+  CU_ASSERT(0 == rv);
 
-  /* Could not send 0-RTT data because buffer is too small. */
-  setup_early_client(&conn);
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     NULL, 0, ++t);
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  CU_ASSERT(spktlen > 0);
 
-  CU_ASSERT(0 == rv);
+  /* Kick delayed ACK timer */
+  t += NGTCP2_SECONDS;
 
-  spktlen = ngtcp2_conn_writev_stream(
-      conn, NULL, NULL, buf,
-      NGTCP2_MIN_LONG_HEADERLEN + 1 + ngtcp2_conn_get_dcid(conn)->datalen +
-          conn->oscid.datalen + 300,
-      &datalen, NGTCP2_WRITE_STREAM_FLAG_FIN, stream_id, NULL, 0, ++t);
+  conn->pktns.tx.last_pkt_num = 1000000009;
+  conn->pktns.rtb.largest_acked_tx_pkt_num = 1000000007;
+  it = ngtcp2_rtb_head(&conn->pktns.rtb);
+  ngtcp2_conn_detect_lost_pkt(conn, &conn->pktns, &conn->cstat, ++t);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
   CU_ASSERT(spktlen > 0);
-  CU_ASSERT(-1 == datalen);
+  CU_ASSERT(NULL == conn->pktns.tx.frq);
+
+  it = ngtcp2_rtb_head(&conn->pktns.rtb);
+
+  CU_ASSERT(!ngtcp2_rtb_it_end(&it));
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_recv_early_data(void) {
+void test_ngtcp2_conn_send_max_stream_data(void) {
   ngtcp2_conn *conn;
   uint8_t buf[2048];
   size_t pktlen;
-  ngtcp2_ssize spktlen;
-  ngtcp2_frame fr;
-  int64_t pkt_num = 1;
-  ngtcp2_tstamp t = 0;
   ngtcp2_strm *strm;
-  ngtcp2_cid rcid;
+  int64_t pkt_num = 890;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_frame fr;
   int rv;
-  my_user_data ud;
-
-  rcid_init(&rcid);
+  const uint32_t datalen = 1024;
 
-  setup_early_server(&conn);
-  conn->callbacks.recv_stream_data = recv_stream_data;
-  conn->user_data = &ud;
+  /* MAX_STREAM_DATA should be sent */
+  setup_default_server(&conn);
+  conn->local.transport_params.initial_max_stream_data_bidi_remote = datalen;
 
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 1221;
-  fr.crypto.data[0].base = null_data;
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = datalen;
+  fr.stream.data[0].base = null_data;
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid, ngtcp2_conn_get_dcid(conn),
-      ++pkt_num, conn->client_chosen_version, &fr, &null_ckm);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  rv = ngtcp2_conn_extend_max_stream_offset(conn, 4, datalen);
 
-  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(0 == rv);
+
+  strm = ngtcp2_conn_find_stream(conn, 4);
+
+  CU_ASSERT(ngtcp2_strm_is_tx_queued(strm));
+
+  ngtcp2_conn_del(conn);
+
+  /* MAX_STREAM_DATA should not be sent on incoming fin */
+  setup_default_server(&conn);
+  conn->local.transport_params.initial_max_stream_data_bidi_remote = datalen;
 
   fr.type = NGTCP2_FRAME_STREAM;
   fr.stream.stream_id = 4;
   fr.stream.fin = 1;
   fr.stream.offset = 0;
   fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 911;
+  fr.stream.data[0].len = datalen;
   fr.stream.data[0].base = null_data;
 
-  pktlen = write_single_frame_0rtt_pkt(
-      buf, sizeof(buf), &rcid, ngtcp2_conn_get_dcid(conn), ++pkt_num,
-      conn->client_chosen_version, &fr, &null_ckm);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  memset(&ud, 0, sizeof(ud));
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(4 == ud.stream_data.stream_id);
-  CU_ASSERT(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_EARLY);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  rv = ngtcp2_conn_extend_max_stream_offset(conn, 4, datalen);
 
-  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(0 == rv);
 
   strm = ngtcp2_conn_find_stream(conn, 4);
 
-  CU_ASSERT(NULL != strm);
-  CU_ASSERT(911 == strm->rx.last_offset);
+  CU_ASSERT(!ngtcp2_strm_is_tx_queued(strm));
 
   ngtcp2_conn_del(conn);
 
-  /* Re-ordered 0-RTT packet */
-  setup_early_server(&conn);
+  /* MAX_STREAM_DATA should not be sent if STOP_SENDING frame is being
+     sent by local endpoint */
+  setup_default_server(&conn);
+  conn->local.transport_params.initial_max_stream_data_bidi_remote = datalen;
 
   fr.type = NGTCP2_FRAME_STREAM;
   fr.stream.stream_id = 4;
-  fr.stream.fin = 1;
+  fr.stream.fin = 0;
   fr.stream.offset = 0;
   fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 119;
+  fr.stream.data[0].len = datalen;
   fr.stream.data[0].base = null_data;
 
-  pktlen = write_single_frame_0rtt_pkt(
-      buf, sizeof(buf), &rcid, ngtcp2_conn_get_dcid(conn), ++pkt_num,
-      conn->client_chosen_version, &fr, &null_ckm);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(NGTCP2_ERR_RETRY == rv);
+  CU_ASSERT(0 == rv);
 
-  ngtcp2_conn_del(conn);
+  rv = ngtcp2_conn_shutdown_stream_read(conn, 4, NGTCP2_APP_ERR01);
 
-  /* Compound packet */
-  setup_early_server(&conn);
+  CU_ASSERT(0 == rv);
 
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 111;
-  fr.crypto.data[0].base = null_data;
+  rv = ngtcp2_conn_extend_max_stream_offset(conn, 4, datalen);
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid, ngtcp2_conn_get_dcid(conn),
-      ++pkt_num, conn->client_chosen_version, &fr, &null_ckm);
+  CU_ASSERT(0 == rv);
+
+  strm = ngtcp2_conn_find_stream(conn, 4);
+
+  CU_ASSERT(!ngtcp2_strm_is_tx_queued(strm));
+
+  ngtcp2_conn_del(conn);
+
+  /* MAX_STREAM_DATA should not be sent if stream is being reset by
+     remote endpoint */
+  setup_default_server(&conn);
+  conn->local.transport_params.initial_max_stream_data_bidi_remote = datalen;
 
   fr.type = NGTCP2_FRAME_STREAM;
   fr.stream.stream_id = 4;
-  fr.stream.fin = 1;
+  fr.stream.fin = 0;
   fr.stream.offset = 0;
   fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 999;
+  fr.stream.data[0].len = datalen;
   fr.stream.data[0].base = null_data;
 
-  pktlen += write_single_frame_0rtt_pkt(
-      buf + pktlen, sizeof(buf) - pktlen, &rcid, ngtcp2_conn_get_dcid(conn),
-      ++pkt_num, conn->client_chosen_version, &fr, &null_ckm);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = 4;
+  fr.reset_stream.app_error_code = NGTCP2_APP_ERR01;
+  fr.reset_stream.final_size = datalen;
 
-  CU_ASSERT(spktlen > 0);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  strm = ngtcp2_conn_find_stream(conn, 4);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(NULL != strm);
-  CU_ASSERT(999 == strm->rx.last_offset);
+  CU_ASSERT(0 == rv);
+
+  rv = ngtcp2_conn_extend_max_stream_offset(conn, 4, datalen);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(ngtcp2_conn_tx_strmq_empty(conn));
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_recv_compound_pkt(void) {
+void test_ngtcp2_conn_recv_stream_data(void) {
+  uint8_t buf[1024];
   ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  size_t pktlen;
-  ngtcp2_ssize spktlen;
-  ngtcp2_frame fr;
-  int64_t pkt_num = 1;
+  my_user_data ud;
+  int64_t pkt_num = 612;
   ngtcp2_tstamp t = 0;
-  ngtcp2_acktr_entry *ackent;
-  int rv;
-  ngtcp2_ksl_it it;
-
-  /* 2 QUIC long packets in one UDP packet */
-  setup_handshake_server(&conn);
+  ngtcp2_frame fr;
+  size_t pktlen;
+  int rv;
+  int64_t stream_id;
+  size_t i;
 
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 611;
-  fr.crypto.data[0].base = null_data;
+  /* 2 STREAM frames are received in the correct order. */
+  setup_default_server(&conn);
+  conn->callbacks.recv_stream_data = recv_stream_data;
+  conn->user_data = &ud;
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
-      ngtcp2_conn_get_dcid(conn), ++pkt_num, conn->client_chosen_version, &fr,
-      &null_ckm);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 111;
+  fr.stream.data[0].base = null_data;
 
-  pktlen += write_single_frame_handshake_pkt(
-      buf + pktlen, sizeof(buf) - pktlen, NGTCP2_PKT_INITIAL, &conn->oscid,
-      ngtcp2_conn_get_dcid(conn), ++pkt_num, conn->client_chosen_version, &fr,
-      &null_ckm);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
+  memset(&ud, 0, sizeof(ud));
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
+  CU_ASSERT(4 == ud.stream_data.stream_id);
+  CU_ASSERT(!(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN));
+  CU_ASSERT(!(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_EARLY));
+  CU_ASSERT(111 == ud.stream_data.datalen);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
-
-  CU_ASSERT(spktlen > 0);
-
-  it = ngtcp2_acktr_get(&conn->in_pktns->acktr);
-  ackent = ngtcp2_ksl_it_get(&it);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 1;
+  fr.stream.offset = 111;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 99;
+  fr.stream.data[0].base = null_data;
 
-  CU_ASSERT(pkt_num == ackent->pkt_num);
-  CU_ASSERT(2 == ackent->len);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  ngtcp2_ksl_it_next(&it);
+  memset(&ud, 0, sizeof(ud));
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(ngtcp2_ksl_it_end(&it));
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(4 == ud.stream_data.stream_id);
+  CU_ASSERT(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN);
+  CU_ASSERT(99 == ud.stream_data.datalen);
 
   ngtcp2_conn_del(conn);
 
-  /* 1 long packet and 1 short packet in one UDP packet */
+  /* 2 STREAM frames are received in the correct order, and 2nd STREAM
+     frame has 0 length, and FIN bit set. */
   setup_default_server(&conn);
-
-  fr.type = NGTCP2_FRAME_PADDING;
-  fr.padding.len = 1;
-
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_HANDSHAKE, &conn->oscid,
-      ngtcp2_conn_get_dcid(conn), ++pkt_num, conn->client_chosen_version, &fr,
-      &null_ckm);
+  conn->callbacks.recv_stream_data = recv_stream_data;
+  conn->user_data = &ud;
 
   fr.type = NGTCP2_FRAME_STREAM;
   fr.stream.stream_id = 4;
   fr.stream.fin = 0;
   fr.stream.offset = 0;
   fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 426;
+  fr.stream.data[0].len = 111;
   fr.stream.data[0].base = null_data;
 
-  pktlen +=
-      write_single_frame_pkt(buf + pktlen, sizeof(buf) - pktlen, &conn->oscid,
-                             ++pkt_num, &fr, conn->pktns.crypto.rx.ckm);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
+  memset(&ud, 0, sizeof(ud));
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
+  CU_ASSERT(4 == ud.stream_data.stream_id);
+  CU_ASSERT(!(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN));
+  CU_ASSERT(111 == ud.stream_data.datalen);
 
-  it = ngtcp2_acktr_get(&conn->pktns.acktr);
-  ackent = ngtcp2_ksl_it_get(&it);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 1;
+  fr.stream.offset = 111;
+  fr.stream.datacnt = 0;
 
-  CU_ASSERT(ackent->pkt_num == pkt_num);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  it = ngtcp2_acktr_get(&conn->hs_pktns->acktr);
+  memset(&ud, 0, sizeof(ud));
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(!ngtcp2_ksl_it_end(&it));
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(4 == ud.stream_data.stream_id);
+  CU_ASSERT(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN);
+  CU_ASSERT(0 == ud.stream_data.datalen);
 
   ngtcp2_conn_del(conn);
-}
 
-void test_ngtcp2_conn_pkt_payloadlen(void) {
-  ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  size_t pktlen;
-  ngtcp2_frame fr;
-  int64_t pkt_num = 1;
-  ngtcp2_tstamp t = 0;
-  uint64_t payloadlen;
-  int rv;
-  const ngtcp2_cid *dcid;
+  /* 2 identical STREAM frames with FIN bit set are received.  The
+     recv_stream_data callback should not be called for sencond STREAM
+     frame. */
+  setup_default_server(&conn);
+  conn->callbacks.recv_stream_data = recv_stream_data;
+  conn->user_data = &ud;
 
-  /* Payload length is invalid */
-  setup_handshake_server(&conn);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 1;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 111;
+  fr.stream.data[0].base = null_data;
 
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 1231;
-  fr.crypto.data[0].base = null_data;
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  dcid = ngtcp2_conn_get_dcid(conn);
+  memset(&ud, 0, sizeof(ud));
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid, dcid, ++pkt_num,
-      conn->client_chosen_version, &fr, &null_ckm);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(4 == ud.stream_data.stream_id);
+  CU_ASSERT(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN);
+  CU_ASSERT(111 == ud.stream_data.datalen);
 
-  payloadlen = read_pkt_payloadlen(buf, dcid, &conn->oscid);
-  write_pkt_payloadlen(buf, dcid, &conn->oscid, payloadlen + 1);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  /* This first packet which does not increase initial packet number
-     space CRYPTO offset or it does not get buffered as 0RTT is an
-     error.  But it is unsecured Initial, so we just ignore it. */
+  memset(&ud, 0, sizeof(ud));
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(NGTCP2_ERR_DROP_CONN == rv);
-  CU_ASSERT(NGTCP2_CS_SERVER_INITIAL == conn->state);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == ud.stream_data.stream_id);
+  CU_ASSERT(!(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN));
+  CU_ASSERT(0 == ud.stream_data.datalen);
 
   ngtcp2_conn_del(conn);
 
-  /* Client Initial packet included in UDP datagram smaller than 1200
-     is discarded. */
-  setup_handshake_server(&conn);
+  /* Re-ordered STREAM frame; we first gets 0 length STREAM frame with
+     FIN bit set. Then the remaining STREAM frame is received. */
+  setup_default_server(&conn);
+  conn->callbacks.recv_stream_data = recv_stream_data;
+  conn->user_data = &ud;
 
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 1000;
-  fr.crypto.data[0].base = null_data;
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 1;
+  fr.stream.offset = 599;
+  fr.stream.datacnt = 0;
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
-      ngtcp2_conn_get_dcid(conn), 0, NGTCP2_PROTO_VER_V1, &fr, &null_ckm);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
+  memset(&ud, 0, sizeof(ud));
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(NGTCP2_ERR_DROP_CONN == rv);
-  CU_ASSERT(NGTCP2_CS_SERVER_INITIAL == conn->state);
-
-  ngtcp2_conn_del(conn);
-}
-
-void test_ngtcp2_conn_writev_stream(void) {
-  ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  ngtcp2_ssize spktlen;
-  ngtcp2_tstamp t = 0;
-  int rv;
-  int64_t stream_id;
-  ngtcp2_vec datav = {null_data, 10};
-  ngtcp2_ssize datalen;
-  size_t left;
-
-  /* 0 length STREAM should not be written if we supply nonzero length
-     data. */
-  setup_default_client(&conn);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == ud.stream_data.stream_id);
 
-  /* This will sends NEW_CONNECTION_ID frames */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 599;
+  fr.stream.data[0].base = null_data;
 
-  CU_ASSERT(spktlen > 0);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  memset(&ud, 0, sizeof(ud));
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-
-  /*
-   * Long header (1+18+1)
-   * STREAM overhead (+3)
-   * AEAD overhead (16)
-   */
-  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, 39, &datalen,
-                                      NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                      &datav, 1, ++t);
-
-  CU_ASSERT(0 == spktlen);
-  CU_ASSERT(-1 == datalen);
+  CU_ASSERT(4 == ud.stream_data.stream_id);
+  CU_ASSERT(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN);
+  CU_ASSERT(599 == ud.stream_data.datalen);
 
   ngtcp2_conn_del(conn);
 
-  /* +1 buffer size */
-  setup_default_client(&conn);
+  /* Simulate the case where packet is lost.  We first gets 0 length
+     STREAM frame with FIN bit set.  Then the lost STREAM frame is
+     retransmitted with FIN bit set is received. */
+  setup_default_server(&conn);
+  conn->callbacks.recv_stream_data = recv_stream_data;
+  conn->user_data = &ud;
 
-  /* This will sends NEW_CONNECTION_ID frames */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 1;
+  fr.stream.offset = 599;
+  fr.stream.datacnt = 0;
 
-  CU_ASSERT(spktlen > 0);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  memset(&ud, 0, sizeof(ud));
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == ud.stream_data.stream_id);
 
-  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, 40, &datalen,
-                                      NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                      &datav, 1, ++t);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 1;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 599;
+  fr.stream.data[0].base = null_data;
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(1 == datalen);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+
+  memset(&ud, 0, sizeof(ud));
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(4 == ud.stream_data.stream_id);
+  CU_ASSERT(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN);
+  CU_ASSERT(599 == ud.stream_data.datalen);
 
   ngtcp2_conn_del(conn);
 
-  /* Coalesces multiple STREAM frames */
+  /* Receive an unidirectional stream data */
   setup_default_client(&conn);
-  conn->local.bidi.max_streams = 100;
-
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  conn->callbacks.recv_stream_data = recv_stream_data;
+  conn->user_data = &ud;
 
-  CU_ASSERT(0 == rv);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 3;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 911;
+  fr.stream.data[0].base = null_data;
 
-  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, 1200, &datalen,
-                                      NGTCP2_WRITE_STREAM_FLAG_MORE, stream_id,
-                                      &datav, 1, ++t);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  CU_ASSERT(NGTCP2_ERR_WRITE_MORE == spktlen);
-  CU_ASSERT(10 == datalen);
+  memset(&ud, 0, sizeof(ud));
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  left = ngtcp2_ppe_left(&conn->pkt.ppe);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(3 == ud.stream_data.stream_id);
+  CU_ASSERT(!(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN));
+  CU_ASSERT(911 == ud.stream_data.datalen);
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(0 == rv);
+  /* Receive an unidirectional stream which is beyond the limit. */
+  setup_default_server(&conn);
+  conn->callbacks.recv_stream_data = recv_stream_data;
+  conn->remote.uni.max_streams = 0;
+  conn->user_data = &ud;
 
-  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, 1200, &datalen,
-                                      NGTCP2_WRITE_STREAM_FLAG_MORE, stream_id,
-                                      &datav, 1, ++t);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 2;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 911;
+  fr.stream.data[0].base = null_data;
 
-  CU_ASSERT(NGTCP2_ERR_WRITE_MORE == spktlen);
-  CU_ASSERT(10 == datalen);
-  CU_ASSERT(ngtcp2_ppe_left(&conn->pkt.ppe) < left);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  memset(&ud, 0, sizeof(ud));
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(NGTCP2_ERR_STREAM_LIMIT == rv);
 
   ngtcp2_conn_del(conn);
 
-  /* 0RTT: Coalesces multiple STREAM frames */
-  setup_early_client(&conn);
-  conn->local.bidi.max_streams = 100;
+  /* Receiving nonzero payload for an local unidirectional stream is a
+     protocol violation. */
+  setup_default_client(&conn);
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  rv = ngtcp2_conn_open_uni_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
 
-  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, 1200, &datalen,
-                                      NGTCP2_WRITE_STREAM_FLAG_MORE, stream_id,
-                                      &datav, 1, ++t);
-
-  CU_ASSERT(NGTCP2_ERR_WRITE_MORE == spktlen);
-  CU_ASSERT(10 == datalen);
-
-  left = ngtcp2_ppe_left(&conn->pkt.ppe);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = stream_id;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 9;
+  fr.stream.data[0].base = null_data;
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  CU_ASSERT(0 == rv);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, 1200, &datalen,
-                                      NGTCP2_WRITE_STREAM_FLAG_MORE, stream_id,
-                                      &datav, 1, ++t);
+  CU_ASSERT(NGTCP2_ERR_STREAM_STATE == rv);
 
-  CU_ASSERT(NGTCP2_ERR_WRITE_MORE == spktlen);
-  CU_ASSERT(10 == datalen);
-  CU_ASSERT(ngtcp2_ppe_left(&conn->pkt.ppe) < left);
+  ngtcp2_conn_del(conn);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  /* DATA on crypto stream, and TLS alert is generated. */
+  setup_default_server(&conn);
+  conn->callbacks.recv_crypto_data = recv_crypto_fatal_alert_generated;
 
-  /* Make sure that packet is padded */
-  CU_ASSERT(1200 == spktlen);
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 139;
+  fr.crypto.data[0].base = null_data;
 
-  ngtcp2_conn_del(conn);
-}
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-void test_ngtcp2_conn_writev_datagram(void) {
-  ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  ngtcp2_ssize spktlen;
-  ngtcp2_tstamp t = 0;
-  ngtcp2_vec datav = {null_data, 10};
-  ngtcp2_vec vec;
-  int accepted;
-  my_user_data ud;
-  ngtcp2_frame fr;
-  size_t pktlen;
-  int rv;
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  setup_default_client(&conn);
-  conn->callbacks.ack_datagram = ack_datagram;
-  conn->remote.transport_params->max_datagram_frame_size = 1 + 1 + 10;
-  conn->user_data = &ud;
+  CU_ASSERT(NGTCP2_ERR_CRYPTO == rv);
 
-  spktlen = ngtcp2_conn_writev_datagram(
-      conn, NULL, NULL, buf, sizeof(buf), &accepted,
-      NGTCP2_WRITE_DATAGRAM_FLAG_NONE, 1000000009, &datav, 1, ++t);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(0 != accepted);
+  /* 0 length STREAM frame is allowed */
+  setup_default_server(&conn);
 
-  fr.type = NGTCP2_FRAME_ACK;
-  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
-  fr.ack.ack_delay = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 0;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
-                                  conn->pktns.crypto.rx.ckm);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  ud.datagram.dgram_id = 0;
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(1000000009 == ud.datagram.dgram_id);
+  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 4));
 
   ngtcp2_conn_del(conn);
 
-  /* Coalesces multiple DATAGRAM frames into a single QUIC packet */
-  setup_default_client(&conn);
-  conn->remote.transport_params->max_datagram_frame_size = 65535;
-
-  spktlen = ngtcp2_conn_writev_datagram(
-      conn, NULL, NULL, buf, sizeof(buf), &accepted,
-      NGTCP2_WRITE_DATAGRAM_FLAG_MORE, 1000000007, &datav, 1, ++t);
-
-  CU_ASSERT(NGTCP2_ERR_WRITE_MORE == spktlen);
-  CU_ASSERT(0 != accepted);
-
-  spktlen = ngtcp2_conn_writev_datagram(
-      conn, NULL, NULL, buf, sizeof(buf), &accepted,
-      NGTCP2_WRITE_DATAGRAM_FLAG_MORE, 1000000007, &datav, 1, ++t);
+  /* After sending STOP_SENDING, receiving 2 STREAM frames with fin
+     bit set must not invoke recv_stream_data callback. */
+  setup_default_server(&conn);
+  conn->callbacks.recv_stream_data = recv_stream_data;
+  conn->user_data = &ud;
 
-  CU_ASSERT(NGTCP2_ERR_WRITE_MORE == spktlen);
-  CU_ASSERT(0 != accepted);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 0;
 
-  spktlen = ngtcp2_conn_writev_datagram(
-      conn, NULL, NULL, buf, sizeof(buf), &accepted,
-      NGTCP2_WRITE_DATAGRAM_FLAG_NONE, 0, &datav, 1, ++t);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(0 != accepted);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  ngtcp2_conn_del(conn);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 4));
 
-  /* DATAGRAM cannot fit into QUIC packet because the other frames
-     occupy the space */
-  setup_default_client(&conn);
-  conn->remote.transport_params->max_datagram_frame_size =
-      1 + ngtcp2_put_varint_len(2000) + 2000;
+  rv = ngtcp2_conn_shutdown_stream_read(conn, 4, 99);
 
-  vec.base = null_data;
-  vec.len = 2000;
+  CU_ASSERT(0 == rv);
 
-  spktlen = ngtcp2_conn_writev_datagram(
-      conn, NULL, NULL, buf, sizeof(buf), &accepted,
-      NGTCP2_WRITE_DATAGRAM_FLAG_NONE, 987, &vec, 1, ++t);
+  for (i = 0; i < 2; ++i) {
+    fr.type = NGTCP2_FRAME_STREAM;
+    fr.stream.stream_id = 4;
+    fr.stream.fin = 1;
+    fr.stream.offset = 0;
+    fr.stream.datacnt = 1;
+    fr.stream.data[0].base = null_data;
+    fr.stream.data[0].len = 19;
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(0 == accepted);
+    pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                    &fr, conn->pktns.crypto.rx.ckm);
 
-  spktlen = ngtcp2_conn_writev_datagram(
-      conn, NULL, NULL, buf, sizeof(buf), &accepted,
-      NGTCP2_WRITE_DATAGRAM_FLAG_NONE, 545, &vec, 1, ++t);
+    ud.stream_data.stream_id = 0;
+    rv =
+        ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(0 != accepted);
+    CU_ASSERT(0 == rv);
+    CU_ASSERT(0 == ud.stream_data.stream_id);
+    CU_ASSERT(19 == conn->rx.offset);
+    CU_ASSERT(19 == conn->rx.unsent_max_offset -
+                        conn->local.transport_params.initial_max_data);
+    CU_ASSERT(conn->local.transport_params.initial_max_data ==
+              conn->rx.max_offset);
+  }
 
   ngtcp2_conn_del(conn);
 
-  /* Calling ngtcp2_conn_writev_datagram without receiving positive
-     max_datagram_frame_size is an error */
-  setup_default_client(&conn);
+  /* After receiving RESET_STREAM, recv_stream_data callback must not
+     be invoked */
+  setup_default_server(&conn);
+  conn->callbacks.recv_stream_data = recv_stream_data;
+  conn->user_data = &ud;
 
-  spktlen = ngtcp2_conn_writev_datagram(
-      conn, NULL, NULL, buf, sizeof(buf), &accepted,
-      NGTCP2_WRITE_DATAGRAM_FLAG_NONE, 999, &datav, 1, ++t);
-
-  CU_ASSERT(NGTCP2_ERR_INVALID_STATE == spktlen);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 0;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 0;
 
-  ngtcp2_conn_del(conn);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  /* Sending DATAGRAM which is larger than the value of received
-     max_datagram_frame_size is an error */
-  setup_default_client(&conn);
-  conn->remote.transport_params->max_datagram_frame_size = 9;
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 0));
 
-  spktlen = ngtcp2_conn_writev_datagram(
-      conn, NULL, NULL, buf, sizeof(buf), &accepted,
-      NGTCP2_WRITE_DATAGRAM_FLAG_NONE, 4433, &datav, 1, ++t);
+  fr.type = NGTCP2_FRAME_RESET_STREAM;
+  fr.reset_stream.stream_id = 0;
+  fr.reset_stream.app_error_code = 999;
+  fr.reset_stream.final_size = 199;
 
-  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == spktlen);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  ngtcp2_conn_del(conn);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != ngtcp2_conn_find_stream(conn, 0));
+  CU_ASSERT(199 == conn->rx.unsent_max_offset -
+                       conn->local.transport_params.initial_max_data);
 
-  /* Send DATAGRAM frame in a 0RTT packet */
-  setup_early_client(&conn);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 0;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].base = null_data;
+  fr.stream.data[0].len = 198;
 
-  conn->remote.transport_params->max_datagram_frame_size = 4311;
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+  ud.stream_data.stream_id = -1;
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  spktlen = ngtcp2_conn_writev_datagram(
-      conn, NULL, NULL, buf, sizeof(buf), &accepted,
-      NGTCP2_WRITE_DATAGRAM_FLAG_NONE, 22360679, &datav, 1, ++t);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(-1 == ud.stream_data.stream_id);
+  CU_ASSERT(199 == conn->rx.unsent_max_offset -
+                       conn->local.transport_params.initial_max_data);
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(0 != accepted);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 0;
+  fr.stream.fin = 1;
+  fr.stream.offset = 198;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].base = null_data;
+  fr.stream.data[0].len = 1;
 
-  ngtcp2_conn_del(conn);
-}
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+  ud.stream_data.stream_id = -1;
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-void test_ngtcp2_conn_recv_datagram(void) {
-  ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  ngtcp2_frame fr;
-  size_t pktlen;
-  int64_t pkt_num = 0;
-  ngtcp2_tstamp t = 0;
-  my_user_data ud;
-  int rv;
-  ngtcp2_cid rcid;
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(-1 == ud.stream_data.stream_id);
+  CU_ASSERT(199 == conn->rx.unsent_max_offset -
+                       conn->local.transport_params.initial_max_data);
 
-  rcid_init(&rcid);
+  ngtcp2_conn_del(conn);
 
+  /* ngtcp2_conn_shutdown_stream_read is called in recv_stream_data
+     callback.  Further recv_stream_data callback must not be
+     called. */
   setup_default_server(&conn);
+  conn->callbacks.recv_stream_data = recv_stream_data_shutdown_stream_read;
   conn->user_data = &ud;
-  conn->callbacks.recv_datagram = recv_datagram;
-  conn->local.transport_params.max_datagram_frame_size = 1 + 1111;
 
-  fr.type = NGTCP2_FRAME_DATAGRAM;
-  fr.datagram.data = fr.datagram.rdata;
-  fr.datagram.data->base = null_data;
-  fr.datagram.data->len = 1111;
-  fr.datagram.datacnt = 1;
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 599;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 1;
+  fr.stream.data[0].base = null_data;
 
   pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
                                   &fr, conn->pktns.crypto.rx.ckm);
@@ -4730,1479 +5125,1475 @@ void test_ngtcp2_conn_recv_datagram(void) {
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(1111 == ud.datagram.datalen);
-  CU_ASSERT(!(NGTCP2_DATAGRAM_FLAG_EARLY & ud.datagram.flags));
-
-  ngtcp2_conn_del(conn);
-
-  /* Receiving DATAGRAM frame which is strictly larger than the
-     declared limit is an error */
-  setup_default_server(&conn);
-  conn->local.transport_params.max_datagram_frame_size = 1 + 1111 - 1;
+  CU_ASSERT(0 == ud.stream_data.stream_id);
 
-  fr.type = NGTCP2_FRAME_DATAGRAM;
-  fr.datagram.data = fr.datagram.rdata;
-  fr.datagram.data->base = null_data;
-  fr.datagram.data->len = 1111;
-  fr.datagram.datacnt = 1;
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 599;
+  fr.stream.data[0].base = null_data;
 
   pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
                                   &fr, conn->pktns.crypto.rx.ckm);
 
+  memset(&ud, 0, sizeof(ud));
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(NGTCP2_ERR_PROTO == rv);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(4 == ud.stream_data.stream_id);
+  CU_ASSERT(!(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN));
+  CU_ASSERT(599 == ud.stream_data.datalen);
 
   ngtcp2_conn_del(conn);
+}
 
-  /* Receiving DATAGRAM frame in a 0RTT packet */
-  setup_early_server(&conn);
-  conn->user_data = &ud;
-  conn->callbacks.recv_datagram = recv_datagram;
-  conn->local.transport_params.max_datagram_frame_size = 1 + 1111;
+void test_ngtcp2_conn_read_pkts(void) {
+  uint8_t buf[2048];
+  ngtcp2_conn *conn;
+  my_user_data ud;
+  int64_t pkt_num = 612;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_frame fr;
+  size_t pktlen, segsize;
+  ngtcp2_strm *strm;
+  int rv;
 
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 1199;
-  fr.crypto.data[0].base = null_data;
+  /* 2 datagrams are coalesced in a single buffer, and the last one is
+     shorter. */
+  setup_default_server(&conn);
+  conn->callbacks.recv_stream_data = recv_stream_data;
+  conn->user_data = &ud;
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid, ngtcp2_conn_get_dcid(conn),
-      ++pkt_num, conn->client_chosen_version, &fr, &null_ckm);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 111;
+  fr.stream.data[0].base = null_data;
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  segsize = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                   &fr, conn->pktns.crypto.rx.ckm);
 
-  CU_ASSERT(0 == rv);
+  fr.stream.fin = 1;
+  fr.stream.offset = 111;
+  fr.stream.data[0].len = 99;
 
-  fr.type = NGTCP2_FRAME_DATAGRAM;
-  fr.datagram.data = fr.datagram.rdata;
-  fr.datagram.data->base = null_data;
-  fr.datagram.data->len = 1111;
-  fr.datagram.datacnt = 1;
+  pktlen = write_single_frame_pkt(buf + segsize, sizeof(buf) - segsize,
+                                  &conn->oscid, ++pkt_num, &fr,
+                                  conn->pktns.crypto.rx.ckm);
 
-  pktlen = write_single_frame_0rtt_pkt(
-      buf, sizeof(buf), &rcid, ngtcp2_conn_get_dcid(conn), ++pkt_num,
-      conn->client_chosen_version, &fr, &null_ckm);
+  CU_ASSERT(pktlen < segsize);
 
   memset(&ud, 0, sizeof(ud));
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_conn_read_pkts(conn, &null_path.path, &null_pi, buf,
+                             segsize + pktlen, segsize, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(1111 == ud.datagram.datalen);
-  CU_ASSERT(NGTCP2_DATAGRAM_FLAG_EARLY & ud.datagram.flags);
+  CU_ASSERT(4 == ud.stream_data.stream_id);
+  CU_ASSERT(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN);
+  CU_ASSERT(99 == ud.stream_data.datalen);
+
+  strm = ngtcp2_conn_find_stream(conn, 4);
+
+  CU_ASSERT(210 == strm->rx.last_offset);
+  CU_ASSERT(pkt_num == conn->pktns.rx.max_pkt_num);
+
+  /* segsize must not be 0. */
+  rv = ngtcp2_conn_read_pkts(conn, &null_path.path, &null_pi, buf,
+                             segsize + pktlen, 0, ++t);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_recv_new_connection_id(void) {
+void test_ngtcp2_conn_decrypt_in_place(void) {
+  uint8_t buf[1024];
   ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  size_t pktlen;
-  ngtcp2_ssize spktlen;
-  ngtcp2_tstamp t = 0;
+  my_user_data ud;
   int64_t pkt_num = 0;
+  ngtcp2_tstamp t = 0;
   ngtcp2_frame fr;
-  ngtcp2_frame frs[16];
-  const uint8_t cid[] = {0xf0, 0xf1, 0xf2, 0xf3};
-  const uint8_t token[NGTCP2_STATELESS_RESET_TOKENLEN] = {0xff};
-  const uint8_t cid2[] = {0xf0, 0xf1, 0xf2, 0xf4};
-  const uint8_t token2[NGTCP2_STATELESS_RESET_TOKENLEN] = {0xfe};
-  const uint8_t cid3[] = {0xf0, 0xf1, 0xf2, 0xf5};
-  const uint8_t token3[NGTCP2_STATELESS_RESET_TOKENLEN] = {0xfd};
-  ngtcp2_dcid *dcid;
+  size_t pktlen;
   int rv;
-  ngtcp2_frame_chain *frc;
-  size_t i;
-
-  setup_default_client(&conn);
-
-  /* This will send NEW_CONNECTION_ID frames */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  CU_ASSERT(spktlen > 0);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.flags = 0;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 111;
+  fr.stream.data[0].base = null_data;
 
-  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  fr.new_connection_id.seq = 1;
-  fr.new_connection_id.retire_prior_to = 0;
-  ngtcp2_cid_init(&fr.new_connection_id.cid, cid, sizeof(cid));
-  memcpy(fr.new_connection_id.stateless_reset_token, token, sizeof(token));
+  /* Stream data is copied into the internal buffer by default. */
+  setup_default_server(&conn);
+  conn->callbacks.recv_stream_data = recv_stream_data;
+  conn->user_data = &ud;
 
   pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
                                   &fr, conn->pktns.crypto.rx.ckm);
 
+  memset(&ud, 0, sizeof(ud));
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(1 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
-
-  assert(ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
-  dcid = ngtcp2_ringbuf_get(&conn->dcid.unused.rb, 0);
+  CU_ASSERT(111 == ud.stream_data.datalen);
+  CU_ASSERT(ud.stream_data.data < buf || ud.stream_data.data >= buf + pktlen);
+  CU_ASSERT(!(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_IN_PLACE));
 
-  CU_ASSERT(ngtcp2_cid_eq(&fr.new_connection_id.cid, &dcid->cid));
-  CU_ASSERT(dcid->flags & NGTCP2_DCID_FLAG_TOKEN_PRESENT);
-  CU_ASSERT(0 == memcmp(fr.new_connection_id.stateless_reset_token, dcid->token,
-                        sizeof(fr.new_connection_id.stateless_reset_token)));
+  ngtcp2_conn_del(conn);
 
-  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  fr.new_connection_id.seq = 2;
-  fr.new_connection_id.retire_prior_to = 2;
-  ngtcp2_cid_init(&fr.new_connection_id.cid, cid2, sizeof(cid2));
-  memcpy(fr.new_connection_id.stateless_reset_token, token2, sizeof(token2));
+  /* Stream data points into the packet buffer. */
+  setup_default_server(&conn);
+  conn->callbacks.recv_stream_data = recv_stream_data;
+  conn->user_data = &ud;
+  conn->local.settings.decrypt_in_place = 1;
 
   pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
                                   &fr, conn->pktns.crypto.rx.ckm);
 
+  memset(&ud, 0, sizeof(ud));
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.bound.rb));
-  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
-  CU_ASSERT(2 == conn->dcid.current.seq);
-  CU_ASSERT(NULL != conn->pktns.tx.frq);
-  CU_ASSERT(2 == conn->dcid.retire_prior_to);
+  CU_ASSERT(4 == ud.stream_data.stream_id);
+  CU_ASSERT(111 == ud.stream_data.datalen);
+  CU_ASSERT(ud.stream_data.data > buf);
+  CU_ASSERT(ud.stream_data.data + ud.stream_data.datalen <= buf + pktlen);
+  CU_ASSERT(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_IN_PLACE);
 
-  frc = conn->pktns.tx.frq;
+  ngtcp2_conn_del(conn);
+}
 
-  CU_ASSERT(NGTCP2_FRAME_RETIRE_CONNECTION_ID == frc->fr.type);
+void test_ngtcp2_conn_recv_ping(void) {
+  uint8_t buf[1024];
+  ngtcp2_conn *conn;
+  int64_t pkt_num = 133;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_frame fr;
+  size_t pktlen;
+  int rv;
 
-  frc = frc->next;
+  setup_default_client(&conn);
 
-  CU_ASSERT(NGTCP2_FRAME_RETIRE_CONNECTION_ID == frc->fr.type);
-  CU_ASSERT(NULL == frc->next);
+  fr.type = NGTCP2_FRAME_PING;
 
-  /* This will send RETIRE_CONNECTION_ID frames */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL == conn->pktns.tx.frq);
 
   ngtcp2_conn_del(conn);
+}
 
-  /* Received connection ID is immediately retired due to packet
-     reordering */
-  setup_default_client(&conn);
-
-  /* This will send NEW_CONNECTION_ID frames */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+void test_ngtcp2_conn_recv_max_stream_data(void) {
+  uint8_t buf[1024];
+  ngtcp2_conn *conn;
+  int64_t pkt_num = 1000000007;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_frame fr;
+  size_t pktlen;
+  int rv;
+  ngtcp2_strm *strm;
 
-  CU_ASSERT(spktlen > 0);
+  /* Receiving MAX_STREAM_DATA to an uninitiated local bidirectional
+     stream ID is an error */
+  setup_default_client(&conn);
 
-  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  fr.new_connection_id.seq = 2;
-  fr.new_connection_id.retire_prior_to = 2;
-  ngtcp2_cid_init(&fr.new_connection_id.cid, cid, sizeof(cid));
-  memcpy(fr.new_connection_id.stateless_reset_token, token, sizeof(token));
+  fr.type = NGTCP2_FRAME_MAX_STREAM_DATA;
+  fr.max_stream_data.stream_id = 4;
+  fr.max_stream_data.max_stream_data = 8092;
 
   pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
                                   &fr, conn->pktns.crypto.rx.ckm);
 
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
-  CU_ASSERT(2 == conn->dcid.current.seq);
-  CU_ASSERT(2 == conn->dcid.retire_prior_to);
-
-  frc = conn->pktns.tx.frq;
-
-  CU_ASSERT(NGTCP2_FRAME_RETIRE_CONNECTION_ID == frc->fr.type);
-  CU_ASSERT(NULL == frc->next);
+  CU_ASSERT(NGTCP2_ERR_STREAM_STATE == rv);
 
-  /* This will send RETIRE_CONNECTION_ID frames */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(spktlen > 0);
+  /* Receiving MAX_STREAM_DATA to an uninitiated local unidirectional
+     stream ID is an error */
+  setup_default_client(&conn);
 
-  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  fr.new_connection_id.seq = 1;
-  fr.new_connection_id.retire_prior_to = 0;
-  ngtcp2_cid_init(&fr.new_connection_id.cid, cid2, sizeof(cid2));
-  memcpy(fr.new_connection_id.stateless_reset_token, token2, sizeof(token2));
+  fr.type = NGTCP2_FRAME_MAX_STREAM_DATA;
+  fr.max_stream_data.stream_id = 2;
+  fr.max_stream_data.max_stream_data = 8092;
 
   pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
                                   &fr, conn->pktns.crypto.rx.ckm);
 
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
-  CU_ASSERT(2 == conn->dcid.current.seq);
-  CU_ASSERT(2 == conn->dcid.retire_prior_to);
-
-  frc = conn->pktns.tx.frq;
-
-  CU_ASSERT(NGTCP2_FRAME_RETIRE_CONNECTION_ID == frc->fr.type);
-  CU_ASSERT(NULL == frc->next);
+  CU_ASSERT(NGTCP2_ERR_STREAM_STATE == rv);
 
   ngtcp2_conn_del(conn);
 
-  /* ngtcp2_pv contains DCIDs that should be retired. */
-  setup_default_server(&conn);
-
-  /* This will send NEW_CONNECTION_ID frames */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
-
-  CU_ASSERT(spktlen > 0);
+  /* Receiving MAX_STREAM_DATA to a remote bidirectional stream which
+     exceeds limit */
+  setup_default_client(&conn);
 
-  assert(NULL == conn->pv);
+  fr.type = NGTCP2_FRAME_MAX_STREAM_DATA;
+  fr.max_stream_data.stream_id = 1;
+  fr.max_stream_data.max_stream_data = 1000000009;
 
-  frs[0].type = NGTCP2_FRAME_PING;
-  frs[1].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  frs[1].new_connection_id.seq = 1;
-  frs[1].new_connection_id.retire_prior_to = 0;
-  ngtcp2_cid_init(&frs[1].new_connection_id.cid, cid, sizeof(cid));
-  memcpy(frs[1].new_connection_id.stateless_reset_token, token, sizeof(token));
-  frs[2].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  frs[2].new_connection_id.seq = 2;
-  frs[2].new_connection_id.retire_prior_to = 0;
-  ngtcp2_cid_init(&frs[2].new_connection_id.cid, cid2, sizeof(cid2));
-  memcpy(frs[2].new_connection_id.stateless_reset_token, token2,
-         sizeof(token2));
-  frs[3].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  frs[3].new_connection_id.seq = 3;
-  frs[3].new_connection_id.retire_prior_to = 0;
-  ngtcp2_cid_init(&frs[3].new_connection_id.cid, cid3, sizeof(cid3));
-  memcpy(frs[3].new_connection_id.stateless_reset_token, token3,
-         sizeof(token3));
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 4,
-                     conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_ERR_STREAM_LIMIT == rv);
 
-  assert(NULL != conn->pv);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(conn->pv->flags & NGTCP2_PV_FLAG_FALLBACK_ON_FAILURE);
-  CU_ASSERT(1 == conn->pv->dcid.seq);
-  CU_ASSERT(0 == conn->pv->fallback_dcid.seq);
-  CU_ASSERT(2 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
+  /* Receiving MAX_STREAM_DATA to a remote bidirectional stream which
+     the local endpoint has not received yet. */
+  setup_default_server(&conn);
 
-  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  fr.new_connection_id.seq = 3;
-  fr.new_connection_id.retire_prior_to = 2;
-  ngtcp2_cid_init(&fr.new_connection_id.cid, cid3, sizeof(cid3));
-  memcpy(fr.new_connection_id.stateless_reset_token, token3, sizeof(token3));
+  fr.type = NGTCP2_FRAME_MAX_STREAM_DATA;
+  fr.max_stream_data.stream_id = 4;
+  fr.max_stream_data.max_stream_data = 1000000009;
 
   pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
                                   &fr, conn->pktns.crypto.rx.ckm);
 
-  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
-  CU_ASSERT(conn->pv->flags & NGTCP2_PV_FLAG_FALLBACK_ON_FAILURE);
-  CU_ASSERT(2 == conn->pv->dcid.seq);
-  CU_ASSERT(3 == conn->pv->fallback_dcid.seq);
-
-  frc = conn->pktns.tx.frq;
 
-  CU_ASSERT(NGTCP2_FRAME_RETIRE_CONNECTION_ID == frc->fr.type);
-  CU_ASSERT(0 == frc->fr.retire_connection_id.seq);
-  frc = frc->next;
+  strm = ngtcp2_conn_find_stream(conn, 4);
 
-  CU_ASSERT(NGTCP2_FRAME_RETIRE_CONNECTION_ID == frc->fr.type);
-  CU_ASSERT(1 == frc->fr.retire_connection_id.seq);
-  CU_ASSERT(NULL == frc->next);
+  CU_ASSERT(NULL != strm);
+  CU_ASSERT(1000000009 == strm->tx.max_offset);
 
   ngtcp2_conn_del(conn);
 
-  /* ngtcp2_pv contains DCID in fallback that should be retired and
-     there is not enough connection ID left.  */
+  /* Receiving MAX_STREAM_DATA to a idle remote unidirectional stream
+     is a protocol violation. */
   setup_default_server(&conn);
 
-  /* This will send NEW_CONNECTION_ID frames */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
-
-  CU_ASSERT(spktlen > 0);
+  fr.type = NGTCP2_FRAME_MAX_STREAM_DATA;
+  fr.max_stream_data.stream_id = 2;
+  fr.max_stream_data.max_stream_data = 1000000009;
 
-  assert(NULL == conn->pv);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  frs[0].type = NGTCP2_FRAME_PING;
-  frs[1].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  frs[1].new_connection_id.seq = 1;
-  frs[1].new_connection_id.retire_prior_to = 0;
-  ngtcp2_cid_init(&frs[1].new_connection_id.cid, cid, sizeof(cid));
-  memcpy(frs[1].new_connection_id.stateless_reset_token, token, sizeof(token));
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 2,
-                     conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
+  CU_ASSERT(NGTCP2_ERR_STREAM_STATE == rv);
 
-  CU_ASSERT(0 == rv);
+  ngtcp2_conn_del(conn);
 
-  assert(NULL != conn->pv);
+  /* Receiving MAX_STREAM_DATA to an existing bidirectional stream */
+  setup_default_server(&conn);
 
-  CU_ASSERT(conn->pv->flags & NGTCP2_PV_FLAG_FALLBACK_ON_FAILURE);
-  CU_ASSERT(1 == conn->pv->dcid.seq);
-  CU_ASSERT(0 == conn->pv->fallback_dcid.seq);
-  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
+  strm = open_stream(conn, 4);
 
-  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  fr.new_connection_id.seq = 2;
-  fr.new_connection_id.retire_prior_to = 2;
-  ngtcp2_cid_init(&fr.new_connection_id.cid, cid2, sizeof(cid2));
-  memcpy(fr.new_connection_id.stateless_reset_token, token2, sizeof(token2));
+  fr.type = NGTCP2_FRAME_MAX_STREAM_DATA;
+  fr.max_stream_data.stream_id = 4;
+  fr.max_stream_data.max_stream_data = 1000000009;
 
   pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
                                   &fr, conn->pktns.crypto.rx.ckm);
 
-  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(2 == conn->dcid.current.seq);
-  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
-  CU_ASSERT(NULL == conn->pv);
+  CU_ASSERT(1000000009 == strm->tx.max_offset);
 
-  frc = conn->pktns.tx.frq;
+  ngtcp2_conn_del(conn);
+}
 
-  CU_ASSERT(NGTCP2_FRAME_RETIRE_CONNECTION_ID == frc->fr.type);
-  CU_ASSERT(0 == frc->fr.retire_connection_id.seq);
+void test_ngtcp2_conn_send_early_data(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_ssize spktlen;
+  ngtcp2_ssize datalen;
+  uint8_t buf[1024];
+  int64_t stream_id;
+  int rv;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_vec datav;
 
-  frc = frc->next;
+  setup_early_client(&conn);
 
-  CU_ASSERT(NGTCP2_FRAME_RETIRE_CONNECTION_ID == frc->fr.type);
-  CU_ASSERT(1 == frc->fr.retire_connection_id.seq);
-  CU_ASSERT(NULL == frc->next);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
-  ngtcp2_conn_del(conn);
+  CU_ASSERT(0 == rv);
 
-  /* ngtcp2_pv contains DCIDs that should be retired and there is not
-     enough connection ID left to continue path validation.  */
-  setup_default_server(&conn);
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &datalen, NGTCP2_WRITE_STREAM_FLAG_FIN,
+                                     stream_id, null_data, 1024, ++t);
 
-  /* This will send NEW_CONNECTION_ID frames */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  CU_ASSERT((ngtcp2_ssize)sizeof(buf) == spktlen);
+  CU_ASSERT(670 == datalen);
 
-  CU_ASSERT(spktlen > 0);
+  ngtcp2_conn_del(conn);
 
-  assert(NULL == conn->pv);
+  /* Verify that Handshake packet and 0-RTT packet are coalesced into
+     one UDP packet. */
+  setup_early_client(&conn);
 
-  frs[0].type = NGTCP2_FRAME_PING;
-  frs[1].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  frs[1].new_connection_id.seq = 1;
-  frs[1].new_connection_id.retire_prior_to = 0;
-  ngtcp2_cid_init(&frs[1].new_connection_id.cid, cid, sizeof(cid));
-  memcpy(frs[1].new_connection_id.stateless_reset_token, token, sizeof(token));
-
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 2,
-                     conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
 
-  assert(NULL != conn->pv);
-
-  CU_ASSERT(conn->pv->flags & NGTCP2_PV_FLAG_FALLBACK_ON_FAILURE);
-  CU_ASSERT(1 == conn->pv->dcid.seq);
-  CU_ASSERT(0 == conn->pv->fallback_dcid.seq);
-  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
+  spktlen =
+      ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, sizeof(buf), &datalen,
+                                NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                null_datav(&datav, 199), 1, ++t);
 
-  /* Overwrite seq in pv->dcid so that pv->dcid cannot be renewed. */
-  conn->pv->dcid.seq = 2;
-  /* Internally we assume that if primary dcid and pv->dcid differ,
-     then no fallback dcid is present. */
-  conn->pv->flags &= (uint8_t)~NGTCP2_PV_FLAG_FALLBACK_ON_FAILURE;
+  CU_ASSERT(sizeof(buf) == spktlen);
+  CU_ASSERT(199 == datalen);
 
-  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  fr.new_connection_id.seq = 3;
-  fr.new_connection_id.retire_prior_to = 3;
-  ngtcp2_cid_init(&fr.new_connection_id.cid, cid3, sizeof(cid3));
-  memcpy(fr.new_connection_id.stateless_reset_token, token3, sizeof(token3));
+  ngtcp2_conn_del(conn);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  /* 0 length 0-RTT packet with FIN bit set */
+  setup_early_client(&conn);
 
-  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(3 == conn->dcid.current.seq);
-  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
-  CU_ASSERT(NULL == conn->pv);
 
-  frc = conn->pktns.tx.frq;
+  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                      &datalen, NGTCP2_WRITE_STREAM_FLAG_FIN,
+                                      stream_id, NULL, 0, ++t);
 
-  CU_ASSERT(NGTCP2_FRAME_RETIRE_CONNECTION_ID == frc->fr.type);
-  CU_ASSERT(2 == frc->fr.retire_connection_id.seq);
+  CU_ASSERT(sizeof(buf) == spktlen);
+  CU_ASSERT(0 == datalen);
 
-  frc = frc->next;
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(NGTCP2_FRAME_RETIRE_CONNECTION_ID == frc->fr.type);
-  CU_ASSERT(1 == frc->fr.retire_connection_id.seq);
-  CU_ASSERT(NULL == frc->next);
+  /* Can write 0 length STREAM frame */
+  setup_early_client(&conn);
 
-  ngtcp2_conn_del(conn);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
-  /* Receiving more than advertised CID is treated as error */
-  setup_default_server(&conn);
-  conn->local.transport_params.active_connection_id_limit = 2;
+  CU_ASSERT(0 == rv);
 
-  /* This will send NEW_CONNECTION_ID frames */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                      &datalen, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                      -1, NULL, 0, ++t);
 
   CU_ASSERT(spktlen > 0);
 
-  assert(NULL == conn->pv);
+  /* We have written Initial.  Now check that STREAM frame is
+     written. */
+  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                      &datalen, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                      stream_id, NULL, 0, ++t);
 
-  frs[0].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  frs[0].new_connection_id.seq = 1;
-  frs[0].new_connection_id.retire_prior_to = 0;
-  ngtcp2_cid_init(&frs[0].new_connection_id.cid, cid, sizeof(cid));
-  memcpy(frs[0].new_connection_id.stateless_reset_token, token, sizeof(token));
-  frs[1].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  frs[1].new_connection_id.seq = 2;
-  frs[1].new_connection_id.retire_prior_to = 0;
-  ngtcp2_cid_init(&frs[1].new_connection_id.cid, cid2, sizeof(cid2));
-  memcpy(frs[1].new_connection_id.stateless_reset_token, token2,
-         sizeof(token2));
-  frs[2].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  frs[2].new_connection_id.seq = 3;
-  frs[2].new_connection_id.retire_prior_to = 0;
-  ngtcp2_cid_init(&frs[2].new_connection_id.cid, cid3, sizeof(cid3));
-  memcpy(frs[2].new_connection_id.stateless_reset_token, token3,
-         sizeof(token3));
+  CU_ASSERT(spktlen > 0);
 
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 3,
-                     conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(NGTCP2_ERR_CONNECTION_ID_LIMIT == rv);
+  /* Could not send 0-RTT data because buffer is too small. */
+  setup_early_client(&conn);
 
-  ngtcp2_conn_del(conn);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
-  /* Receiving duplicated NEW_CONNECTION_ID frame */
-  setup_default_server(&conn);
+  CU_ASSERT(0 == rv);
 
-  /* This will send NEW_CONNECTION_ID frames */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  spktlen = ngtcp2_conn_writev_stream(
+      conn, NULL, NULL, buf,
+      NGTCP2_MIN_LONG_HEADERLEN + 1 + ngtcp2_conn_get_dcid(conn)->datalen +
+          conn->oscid.datalen + 300,
+      &datalen, NGTCP2_WRITE_STREAM_FLAG_FIN, stream_id, NULL, 0, ++t);
 
   CU_ASSERT(spktlen > 0);
+  CU_ASSERT(-1 == datalen);
 
-  frs[0].type = NGTCP2_FRAME_PING;
+  ngtcp2_conn_del(conn);
+}
 
-  frs[1].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  frs[1].new_connection_id.seq = 1;
-  frs[1].new_connection_id.retire_prior_to = 1;
-  ngtcp2_cid_init(&frs[1].new_connection_id.cid, cid, sizeof(cid));
-  memcpy(frs[1].new_connection_id.stateless_reset_token, token, sizeof(token));
+void test_ngtcp2_conn_recv_early_data(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_ssize spktlen;
+  ngtcp2_frame fr;
+  int64_t pkt_num = 1;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_strm *strm;
+  ngtcp2_cid rcid;
+  int rv;
+  my_user_data ud;
 
-  frs[2].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  frs[2].new_connection_id.seq = 2;
-  frs[2].new_connection_id.retire_prior_to = 1;
-  ngtcp2_cid_init(&frs[2].new_connection_id.cid, cid2, sizeof(cid2));
-  memcpy(frs[2].new_connection_id.stateless_reset_token, token2,
-         sizeof(token2));
+  rcid_init(&rcid);
 
-  frs[3].type = NGTCP2_FRAME_PADDING;
-  frs[3].padding.len = 1200;
+  setup_early_server(&conn);
+  conn->callbacks.recv_stream_data = recv_stream_data;
+  conn->user_data = &ud;
 
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 4,
-                     conn->pktns.crypto.rx.ckm);
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 1221;
+  fr.crypto.data[0].base = null_data;
 
-  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid, ngtcp2_conn_get_dcid(conn),
+      ++pkt_num, conn->client_chosen_version, &fr, &null_ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
-  CU_ASSERT(2 == conn->dcid.current.seq);
-  CU_ASSERT(NULL != conn->pv);
-  CU_ASSERT(ngtcp2_cid_eq(&frs[1].new_connection_id.cid,
-                          &conn->pv->fallback_dcid.cid));
 
-  /* This will send PATH_CHALLENGE frame */
   spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  CU_ASSERT(spktlen >= 1200);
+  CU_ASSERT(spktlen > 0);
 
-  fr.type = NGTCP2_FRAME_PATH_RESPONSE;
-  memset(fr.path_response.data, 0, sizeof(fr.path_response.data));
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 1;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 911;
+  fr.stream.data[0].base = null_data;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  pktlen = write_single_frame_0rtt_pkt(
+      buf, sizeof(buf), &rcid, ngtcp2_conn_get_dcid(conn), ++pkt_num,
+      conn->client_chosen_version, &fr, &null_ckm);
 
-  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
+  memset(&ud, 0, sizeof(ud));
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  /* Server starts probing old path */
-  CU_ASSERT(NULL != conn->pv);
-  CU_ASSERT(ngtcp2_path_eq(&null_path.path, &conn->pv->dcid.ps.path));
+  CU_ASSERT(4 == ud.stream_data.stream_id);
+  CU_ASSERT(ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_EARLY);
 
-  /* Receive NEW_CONNECTION_ID seq=1 again, which should be ignored. */
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 2,
-                     conn->pktns.crypto.rx.ckm);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
+  CU_ASSERT(spktlen > 0);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
-  CU_ASSERT(2 == conn->dcid.current.seq);
+  strm = ngtcp2_conn_find_stream(conn, 4);
 
-  ngtcp2_conn_del(conn);
+  CU_ASSERT(NULL != strm);
+  CU_ASSERT(911 == strm->rx.last_offset);
 
-  /* Exceeding the limit for the number of unacknowledged
-     RETIRE_CONNECTION_ID leads to NGTCP2_ERR_CONNECTION_ID_LIMIT. */
-  setup_default_server(&conn);
+  ngtcp2_conn_del(conn);
 
-  /* This will send NEW_CONNECTION_ID frames */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  /* Re-ordered 0-RTT packet */
+  setup_early_server(&conn);
 
-  CU_ASSERT(spktlen > 0);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 1;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 119;
+  fr.stream.data[0].base = null_data;
 
-  for (i = 0; i < 7; ++i) {
-    frs[i].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-    frs[i].new_connection_id.seq = i + 1;
-    frs[i].new_connection_id.retire_prior_to = 0;
-    ngtcp2_cid_init(&frs[i].new_connection_id.cid, cid, sizeof(cid));
-    frs[i].new_connection_id.cid.data[0] = (uint8_t)i;
-    memcpy(frs[i].new_connection_id.stateless_reset_token, token,
-           sizeof(token));
-  }
+  pktlen = write_single_frame_0rtt_pkt(
+      buf, sizeof(buf), &rcid, ngtcp2_conn_get_dcid(conn), ++pkt_num,
+      conn->client_chosen_version, &fr, &null_ckm);
 
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 7,
-                     conn->pktns.crypto.rx.ckm);
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(0 == rv);
-
-  for (i = 0; i < 8; ++i) {
-    frs[i].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-    frs[i].new_connection_id.seq = i + 8;
-    frs[i].new_connection_id.retire_prior_to = 8;
-    ngtcp2_cid_init(&frs[i].new_connection_id.cid, cid, sizeof(cid));
-    frs[i].new_connection_id.cid.data[0] = (uint8_t)(i + 8);
-    memcpy(frs[i].new_connection_id.stateless_reset_token, token,
-           sizeof(token));
-  }
+  CU_ASSERT(NGTCP2_ERR_RETRY == rv);
 
-  for (i = 0; i < 8; ++i) {
-    frs[i + 8].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-    frs[i + 8].new_connection_id.seq = i + 16;
-    frs[i + 8].new_connection_id.retire_prior_to = 16;
-    ngtcp2_cid_init(&frs[i + 8].new_connection_id.cid, cid, sizeof(cid));
-    frs[i + 8].new_connection_id.cid.data[0] = (uint8_t)(i + 16);
-    memcpy(frs[i + 8].new_connection_id.stateless_reset_token, token,
-           sizeof(token));
-  }
+  ngtcp2_conn_del(conn);
 
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 16,
-                     conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  /* Compound packet */
+  setup_early_server(&conn);
 
-  CU_ASSERT(0 == rv);
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 111;
+  fr.crypto.data[0].base = null_data;
 
-  frs[0].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  frs[0].new_connection_id.seq = 24;
-  frs[0].new_connection_id.retire_prior_to = 17;
-  ngtcp2_cid_init(&frs[0].new_connection_id.cid, cid, sizeof(cid));
-  frs[0].new_connection_id.cid.data[0] = (uint8_t)(i + 24);
-  memcpy(frs[0].new_connection_id.stateless_reset_token, token, sizeof(token));
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid, ngtcp2_conn_get_dcid(conn),
+      ++pkt_num, conn->client_chosen_version, &fr, &null_ckm);
+
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 1;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 999;
+  fr.stream.data[0].base = null_data;
+
+  pktlen += write_single_frame_0rtt_pkt(
+      buf + pktlen, sizeof(buf) - pktlen, &rcid, ngtcp2_conn_get_dcid(conn),
+      ++pkt_num, conn->client_chosen_version, &fr, &null_ckm);
 
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 1,
-                     conn->pktns.crypto.rx.ckm);
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(NGTCP2_ERR_CONNECTION_ID_LIMIT == rv);
+  CU_ASSERT(0 == rv);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  strm = ngtcp2_conn_find_stream(conn, 4);
+
+  CU_ASSERT(NULL != strm);
+  CU_ASSERT(999 == strm->rx.last_offset);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_recv_retire_connection_id(void) {
+void test_ngtcp2_conn_recv_compound_pkt(void) {
   ngtcp2_conn *conn;
   uint8_t buf[2048];
   size_t pktlen;
   ngtcp2_ssize spktlen;
-  ngtcp2_tstamp t = 1000000009;
-  int64_t pkt_num = 0;
   ngtcp2_frame fr;
+  int64_t pkt_num = 1;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_acktr_entry *ackent;
   int rv;
-  ngtcp2_ksl_it it;
-  ngtcp2_scid *scid;
-  uint64_t seq;
-
-  setup_default_client(&conn);
-  conn->remote.transport_params->active_connection_id_limit = 7;
-
-  /* This will send NEW_CONNECTION_ID frames */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), t);
-
-  CU_ASSERT(spktlen > 0);
 
-  it = ngtcp2_ksl_begin(&conn->scid.set);
-  scid = ngtcp2_ksl_it_get(&it);
-  seq = scid->seq;
+  /* 2 QUIC long packets in one UDP packet */
+  setup_handshake_server(&conn);
 
-  CU_ASSERT(NGTCP2_SCID_FLAG_NONE == scid->flags);
-  CU_ASSERT(UINT64_MAX == scid->retired_ts);
-  CU_ASSERT(1 == ngtcp2_pq_size(&conn->scid.used));
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 611;
+  fr.crypto.data[0].base = null_data;
 
-  fr.type = NGTCP2_FRAME_RETIRE_CONNECTION_ID;
-  fr.retire_connection_id.seq = seq;
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
+      ngtcp2_conn_get_dcid(conn), ++pkt_num, conn->client_chosen_version, &fr,
+      &null_ckm);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  pktlen += write_single_frame_handshake_pkt(
+      buf + pktlen, sizeof(buf) - pktlen, NGTCP2_PKT_INITIAL, &conn->oscid,
+      ngtcp2_conn_get_dcid(conn), ++pkt_num, conn->client_chosen_version, &fr,
+      &null_ckm);
 
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NGTCP2_SCID_FLAG_RETIRED == scid->flags);
-  CU_ASSERT(1000000010 == scid->retired_ts);
-  CU_ASSERT(2 == ngtcp2_pq_size(&conn->scid.used));
-  CU_ASSERT(7 == ngtcp2_ksl_len(&conn->scid.set));
-  CU_ASSERT(1 == conn->scid.num_retired);
 
-  /* One NEW_CONNECTION_ID frame is sent as a replacement. */
   spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
   CU_ASSERT(spktlen > 0);
-  CU_ASSERT(8 == ngtcp2_ksl_len(&conn->scid.set));
-  CU_ASSERT(1 == conn->scid.num_retired);
-
-  /* No NEW_CONNECTION_ID frames should be sent. */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
-
-  CU_ASSERT(spktlen == 0);
-  CU_ASSERT(8 == ngtcp2_ksl_len(&conn->scid.set));
-  CU_ASSERT(1 == conn->scid.num_retired);
 
-  /* Now time passed and retired connection ID is removed */
-  t += 7 * NGTCP2_DEFAULT_INITIAL_RTT;
+  CU_ASSERT(1 == ngtcp2_acktr_len(&conn->in_pktns->acktr));
 
-  ngtcp2_conn_handle_expiry(conn, t);
+  ackent = ngtcp2_acktr_get(&conn->in_pktns->acktr, 0);
 
-  CU_ASSERT(7 == ngtcp2_ksl_len(&conn->scid.set));
-  CU_ASSERT(0 == conn->scid.num_retired);
+  CU_ASSERT(pkt_num == ackent->pkt_num);
+  CU_ASSERT(2 == ackent->len);
 
   ngtcp2_conn_del(conn);
 
-  /* Receiving RETIRE_CONNECTION_ID with seq which is greater than the
-     sequence number previously sent must be treated as error */
+  /* 1 long packet and 1 short packet in one UDP packet */
   setup_default_server(&conn);
 
-  fr.type = NGTCP2_FRAME_RETIRE_CONNECTION_ID;
-  fr.retire_connection_id.seq = 1;
+  fr.type = NGTCP2_FRAME_PADDING;
+  fr.padding.len = 1;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_HANDSHAKE, &conn->oscid,
+      ngtcp2_conn_get_dcid(conn), ++pkt_num, conn->client_chosen_version, &fr,
+      &null_ckm);
+
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 426;
+  fr.stream.data[0].base = null_data;
+
+  pktlen +=
+      write_single_frame_pkt(buf + pktlen, sizeof(buf) - pktlen, &conn->oscid,
+                             ++pkt_num, &fr, conn->pktns.crypto.rx.ckm);
 
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(NGTCP2_ERR_PROTO == rv);
+  CU_ASSERT(0 == rv);
+
+  ackent = ngtcp2_acktr_get(&conn->pktns.acktr, 0);
+
+  CU_ASSERT(ackent->pkt_num == pkt_num);
+  CU_ASSERT(!ngtcp2_acktr_empty(&conn->hs_pktns->acktr));
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_server_path_validation(void) {
+void test_ngtcp2_conn_pkt_payloadlen(void) {
   ngtcp2_conn *conn;
   uint8_t buf[2048];
   size_t pktlen;
-  ngtcp2_ssize spktlen;
-  ngtcp2_tstamp t = 900;
-  int64_t pkt_num = 0;
   ngtcp2_frame fr;
+  int64_t pkt_num = 1;
+  ngtcp2_tstamp t = 0;
+  uint64_t payloadlen;
   int rv;
-  const uint8_t raw_cid[] = {0x0f, 0x00, 0x00, 0x00};
-  ngtcp2_cid cid, *new_cid;
-  const uint8_t token[NGTCP2_STATELESS_RESET_TOKENLEN] = {0xff};
-  ngtcp2_path_storage new_path1, new_path2;
-  ngtcp2_ksl_it it;
+  const ngtcp2_cid *dcid;
 
-  path_init(&new_path1, 0, 0, 2, 0);
-  path_init(&new_path2, 0, 0, 3, 0);
+  /* Payload length is invalid */
+  setup_handshake_server(&conn);
 
-  ngtcp2_cid_init(&cid, raw_cid, sizeof(raw_cid));
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 1231;
+  fr.crypto.data[0].base = null_data;
 
-  setup_default_server(&conn);
+  dcid = ngtcp2_conn_get_dcid(conn);
 
-  /* This will send NEW_CONNECTION_ID frames */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid, dcid, ++pkt_num,
+      conn->client_chosen_version, &fr, &null_ckm);
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(ngtcp2_ksl_len(&conn->scid.set) > 1);
+  payloadlen = read_pkt_payloadlen(buf, dcid, &conn->oscid);
+  write_pkt_payloadlen(buf, dcid, &conn->oscid, payloadlen + 1);
 
-  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  fr.new_connection_id.seq = 1;
-  fr.new_connection_id.retire_prior_to = 0;
-  fr.new_connection_id.cid = cid;
-  memcpy(fr.new_connection_id.stateless_reset_token, token, sizeof(token));
+  /* This first packet which does not increase initial packet number
+     space CRYPTO offset or it does not get buffered as 0RTT is an
+     error.  But it is unsecured Initial, so we just ignore it. */
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  CU_ASSERT(NGTCP2_ERR_DROP_CONN == rv);
+  CU_ASSERT(NGTCP2_CS_SERVER_INITIAL == conn->state);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(0 == rv);
+  /* Client Initial packet included in UDP datagram smaller than 1200
+     is discarded. */
+  setup_handshake_server(&conn);
 
-  fr.type = NGTCP2_FRAME_PING;
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 1000;
+  fr.crypto.data[0].base = null_data;
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
+      ngtcp2_conn_get_dcid(conn), 0, NGTCP2_PROTO_VER_V1, &fr, &null_ckm);
 
-  rv = ngtcp2_conn_read_pkt(conn, &new_path1.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL != conn->pv);
+  CU_ASSERT(NGTCP2_ERR_DROP_CONN == rv);
+  CU_ASSERT(NGTCP2_CS_SERVER_INITIAL == conn->state);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  ngtcp2_conn_del(conn);
+}
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(ngtcp2_ringbuf_len(&conn->pv->ents.rb) > 0);
+void test_ngtcp2_conn_writev_stream(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  ngtcp2_ssize spktlen;
+  ngtcp2_tstamp t = 0;
+  int rv;
+  int64_t stream_id;
+  ngtcp2_vec datav = {null_data, 10};
+  ngtcp2_ssize datalen;
+  size_t left;
+  ngtcp2_rtb_it it;
+  ngtcp2_rtb_entry *ent;
 
-  fr.type = NGTCP2_FRAME_PATH_RESPONSE;
-  memset(fr.path_response.data, 0, sizeof(fr.path_response.data));
+  /* 0 length STREAM should not be written if we supply nonzero length
+     data. */
+  setup_default_client(&conn);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  /* This will sends NEW_CONNECTION_ID frames */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  rv = ngtcp2_conn_read_pkt(conn, &new_path1.path, &null_pi, buf, pktlen, ++t);
+  CU_ASSERT(spktlen > 0);
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(ngtcp2_path_eq(&new_path1.path, &conn->dcid.current.ps.path));
-  /* DCID does not change because the client does not change its
-     DCID. */
-  CU_ASSERT(!ngtcp2_cid_eq(&cid, &conn->dcid.current.cid));
 
-  /* A remote endpoint changes DCID as well */
-  fr.type = NGTCP2_FRAME_PING;
+  /*
+   * Long header (1+18+1)
+   * STREAM overhead (+3)
+   * AEAD overhead (16)
+   */
+  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, 39, &datalen,
+                                      NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                      &datav, 1, ++t);
 
-  it = ngtcp2_ksl_begin(&conn->scid.set);
+  CU_ASSERT(0 == spktlen);
+  CU_ASSERT(-1 == datalen);
 
-  assert(!ngtcp2_ksl_it_end(&it));
+  ngtcp2_conn_del(conn);
 
-  new_cid = &(((ngtcp2_scid *)ngtcp2_ksl_it_get(&it))->cid);
+  /* +1 buffer size */
+  setup_default_client(&conn);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), new_cid, ++pkt_num, &fr,
-                                  conn->pktns.crypto.rx.ckm);
+  /* This will sends NEW_CONNECTION_ID frames */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  rv = ngtcp2_conn_read_pkt(conn, &new_path2.path, &null_pi, buf, pktlen, ++t);
+  CU_ASSERT(spktlen > 0);
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL != conn->pv);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, 40, &datalen,
+                                      NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                      &datav, 1, ++t);
 
   CU_ASSERT(spktlen > 0);
-  CU_ASSERT(ngtcp2_ringbuf_len(&conn->pv->ents.rb) > 0);
+  CU_ASSERT(1 == datalen);
 
-  fr.type = NGTCP2_FRAME_PATH_RESPONSE;
-  memset(fr.path_response.data, 0, sizeof(fr.path_response.data));
+  ngtcp2_conn_del(conn);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), new_cid, ++pkt_num, &fr,
-                                  conn->pktns.crypto.rx.ckm);
+  /* Coalesces multiple STREAM frames */
+  setup_default_client(&conn);
+  conn->local.bidi.max_streams = 100;
 
-  rv = ngtcp2_conn_read_pkt(conn, &new_path2.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(ngtcp2_path_eq(&new_path2.path, &conn->dcid.current.ps.path));
-  CU_ASSERT(ngtcp2_cid_eq(&cid, &conn->dcid.current.cid));
 
-  ngtcp2_conn_del(conn);
-}
+  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, 1200, &datalen,
+                                      NGTCP2_WRITE_STREAM_FLAG_MORE, stream_id,
+                                      &datav, 1, ++t);
 
-void test_ngtcp2_conn_client_connection_migration(void) {
-  ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  size_t pktlen;
-  ngtcp2_tstamp t = 900;
-  int64_t pkt_num = 0;
-  ngtcp2_frame fr;
-  int rv;
-  const uint8_t raw_cid[] = {0x0f, 0x00, 0x00, 0x00};
-  ngtcp2_cid cid;
-  const uint8_t token[NGTCP2_STATELESS_RESET_TOKENLEN] = {0xff};
-  my_user_data ud;
-  ngtcp2_ssize spktlen;
-  ngtcp2_path_storage to_path;
+  CU_ASSERT(NGTCP2_ERR_WRITE_MORE == spktlen);
+  CU_ASSERT(10 == datalen);
 
-  ngtcp2_cid_init(&cid, raw_cid, sizeof(raw_cid));
+  left = ngtcp2_ppe_left(&conn->pkt.ppe);
 
-  /* immediate migration */
-  setup_default_client(&conn);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
-  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  fr.new_connection_id.seq = 1;
-  fr.new_connection_id.retire_prior_to = 0;
-  fr.new_connection_id.cid = cid;
-  memcpy(fr.new_connection_id.stateless_reset_token, token, sizeof(token));
+  CU_ASSERT(0 == rv);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, 1200, &datalen,
+                                      NGTCP2_WRITE_STREAM_FLAG_MORE, stream_id,
+                                      &datav, 1, ++t);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  CU_ASSERT(NGTCP2_ERR_WRITE_MORE == spktlen);
+  CU_ASSERT(10 == datalen);
+  CU_ASSERT(ngtcp2_ppe_left(&conn->pkt.ppe) < left);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  ngtcp2_conn_del(conn);
+
+  /* 0RTT: Coalesces multiple STREAM frames */
+  setup_early_client(&conn);
+  conn->local.bidi.max_streams = 100;
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
 
-  ngtcp2_path_storage_init2(&to_path, &new_path.path);
-  to_path.path.user_data = &ud;
+  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, 1200, &datalen,
+                                      NGTCP2_WRITE_STREAM_FLAG_MORE, stream_id,
+                                      &datav, 1, ++t);
 
-  rv = ngtcp2_conn_initiate_immediate_migration(conn, &to_path.path, ++t);
+  CU_ASSERT(NGTCP2_ERR_WRITE_MORE == spktlen);
+  CU_ASSERT(10 == datalen);
+
+  left = ngtcp2_ppe_left(&conn->pkt.ppe);
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL == conn->pv);
-  CU_ASSERT(ngtcp2_path_eq(&to_path.path, &conn->dcid.current.ps.path));
-  CU_ASSERT(&ud == conn->dcid.current.ps.path.user_data);
-  CU_ASSERT(ngtcp2_cid_eq(&cid, &conn->dcid.current.cid));
+
+  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, 1200, &datalen,
+                                      NGTCP2_WRITE_STREAM_FLAG_MORE, stream_id,
+                                      &datav, 1, ++t);
+
+  CU_ASSERT(NGTCP2_ERR_WRITE_MORE == spktlen);
+  CU_ASSERT(10 == datalen);
+  CU_ASSERT(ngtcp2_ppe_left(&conn->pkt.ppe) < left);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  /* Make sure that packet is padded */
+  CU_ASSERT(1200 == spktlen);
 
   ngtcp2_conn_del(conn);
 
-  /* migrate after successful path validation */
+  /* A packet in steady state only contains STREAM frame */
   setup_default_client(&conn);
 
-  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  fr.new_connection_id.seq = 1;
-  fr.new_connection_id.retire_prior_to = 0;
-  fr.new_connection_id.cid = cid;
-  memcpy(fr.new_connection_id.stateless_reset_token, token, sizeof(token));
+  /* This will sends NEW_CONNECTION_ID frames */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  CU_ASSERT(spktlen > 0);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
 
-  ngtcp2_path_storage_init2(&to_path, &new_path.path);
-  to_path.path.user_data = &ud;
+  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, 1200, &datalen,
+                                      NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                      &datav, 1, ++t);
 
-  rv = ngtcp2_conn_initiate_migration(conn, &to_path.path, ++t);
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(10 == datalen);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL != conn->pv);
-  CU_ASSERT(ngtcp2_path_eq(&null_path.path, &conn->dcid.current.ps.path));
-  CU_ASSERT(NULL == conn->dcid.current.ps.path.user_data);
-  CU_ASSERT(ngtcp2_cid_eq(&conn->rcid, &conn->dcid.current.cid));
+  it = ngtcp2_rtb_head(&conn->pktns.rtb);
+  ent = ngtcp2_rtb_it_get(&it);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  CU_ASSERT(conn->pktns.tx.last_pkt_num == ent->hd.pkt_num);
+  CU_ASSERT(NGTCP2_FRAME_STREAM == ent->frc->fr.type);
+  CU_ASSERT(10 == ent->frc->fr.stream.data[0].len);
+  CU_ASSERT(NULL == ent->frc->next);
 
-  CU_ASSERT(0 < spktlen);
+  /* Pending MAX_DATA is written along with STREAM frame */
+  conn->rx.unsent_max_offset += conn->rx.window;
 
-  fr.type = NGTCP2_FRAME_PATH_RESPONSE;
-  memset(fr.path_response.data, 0, sizeof(fr.path_response.data));
+  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, 1200, &datalen,
+                                      NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                      &datav, 1, ++t);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(10 == datalen);
+  CU_ASSERT(conn->rx.unsent_max_offset == conn->rx.max_offset);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  it = ngtcp2_rtb_head(&conn->pktns.rtb);
+  ent = ngtcp2_rtb_it_get(&it);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL == conn->pv);
-  CU_ASSERT(ngtcp2_path_eq(&to_path.path, &conn->dcid.current.ps.path));
-  CU_ASSERT(&ud == conn->dcid.current.ps.path.user_data);
-  CU_ASSERT(ngtcp2_cid_eq(&cid, &conn->dcid.current.cid));
+  CU_ASSERT(NGTCP2_FRAME_MAX_DATA == ent->frc->fr.type);
+  CU_ASSERT(NGTCP2_FRAME_STREAM == ent->frc->next->fr.type);
+  CU_ASSERT(NULL == ent->frc->next->next);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_recv_path_challenge(void) {
+void test_ngtcp2_conn_writev_datagram(void) {
   ngtcp2_conn *conn;
   uint8_t buf[2048];
-  size_t pktlen;
   ngtcp2_ssize spktlen;
-  ngtcp2_tstamp t = 11;
-  int64_t pkt_num = 0;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_vec datav = {null_data, 10};
+  ngtcp2_vec vec;
+  int accepted;
+  my_user_data ud;
   ngtcp2_frame fr;
-  ngtcp2_frame frs[2];
+  size_t pktlen;
   int rv;
-  const uint8_t raw_cid[] = {0x0f, 0x00, 0x00, 0x00};
-  ngtcp2_cid cid;
-  const uint8_t token[NGTCP2_STATELESS_RESET_TOKENLEN] = {0xff};
-  const uint8_t data[] = {0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8};
-  const uint8_t data2[] = {0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf9};
-  ngtcp2_path_storage ps;
-  ngtcp2_ssize shdlen;
-  ngtcp2_pkt_hd hd;
 
-  ngtcp2_cid_init(&cid, raw_cid, sizeof(raw_cid));
+  setup_default_client(&conn);
+  conn->callbacks.ack_datagram = ack_datagram;
+  conn->remote.transport_params->max_datagram_frame_size = 1 + 1 + 10;
+  conn->user_data = &ud;
 
-  setup_default_server(&conn);
+  spktlen = ngtcp2_conn_writev_datagram(
+      conn, NULL, NULL, buf, sizeof(buf), &accepted,
+      NGTCP2_WRITE_DATAGRAM_FLAG_NONE, 1000000009, &datav, 1, ++t);
 
-  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  fr.new_connection_id.seq = 1;
-  fr.new_connection_id.retire_prior_to = 0;
-  fr.new_connection_id.cid = cid;
-  memcpy(fr.new_connection_id.stateless_reset_token, token, sizeof(token));
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(0 != accepted);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
+                                  conn->pktns.crypto.rx.ckm);
 
+  ud.datagram.dgram_id = 0;
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
+  CU_ASSERT(1000000009 == ud.datagram.dgram_id);
 
-  frs[0].type = NGTCP2_FRAME_PATH_CHALLENGE;
-  memcpy(frs[0].path_challenge.data, data, sizeof(frs[0].path_challenge.data));
-  frs[1].type = NGTCP2_FRAME_PADDING;
-  frs[1].padding.len = 1200;
-
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 2,
-                     conn->pktns.crypto.rx.ckm);
+  ngtcp2_conn_del(conn);
 
-  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
+  /* Coalesces multiple DATAGRAM frames into a single QUIC packet */
+  setup_default_client(&conn);
+  conn->remote.transport_params->max_datagram_frame_size = 65535;
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(ngtcp2_ringbuf_len(&conn->rx.path_challenge.rb) > 0);
+  spktlen = ngtcp2_conn_writev_datagram(
+      conn, NULL, NULL, buf, sizeof(buf), &accepted,
+      NGTCP2_WRITE_DATAGRAM_FLAG_MORE, 1000000007, &datav, 1, ++t);
 
-  ngtcp2_path_storage_zero(&ps);
+  CU_ASSERT(NGTCP2_ERR_WRITE_MORE == spktlen);
+  CU_ASSERT(0 != accepted);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, &ps.path, NULL, buf, sizeof(buf), ++t);
+  spktlen = ngtcp2_conn_writev_datagram(
+      conn, NULL, NULL, buf, sizeof(buf), &accepted,
+      NGTCP2_WRITE_DATAGRAM_FLAG_MORE, 1000000007, &datav, 1, ++t);
 
-  CU_ASSERT(spktlen >= 1200);
-  CU_ASSERT(ngtcp2_path_eq(&new_path.path, &ps.path));
-  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->rx.path_challenge.rb));
-  CU_ASSERT(1 == ngtcp2_ringbuf_len(&conn->dcid.bound.rb));
+  CU_ASSERT(NGTCP2_ERR_WRITE_MORE == spktlen);
+  CU_ASSERT(0 != accepted);
 
-  shdlen = ngtcp2_pkt_decode_hd_short(&hd, buf, (size_t)spktlen, cid.datalen);
+  spktlen = ngtcp2_conn_writev_datagram(
+      conn, NULL, NULL, buf, sizeof(buf), &accepted,
+      NGTCP2_WRITE_DATAGRAM_FLAG_NONE, 0, &datav, 1, ++t);
 
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(ngtcp2_cid_eq(&cid, &hd.dcid));
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(0 != accepted);
 
-  /* Use same bound DCID for PATH_CHALLENGE from the same path. */
-  fr.type = NGTCP2_FRAME_PATH_CHALLENGE;
-  memcpy(fr.path_challenge.data, data2, sizeof(fr.path_challenge.data));
+  ngtcp2_conn_del(conn);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  /* DATAGRAM cannot fit into QUIC packet because the other frames
+     occupy the space */
+  setup_default_client(&conn);
+  conn->remote.transport_params->max_datagram_frame_size =
+      1 + ngtcp2_put_varint_len(2000) + 2000;
 
-  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
+  vec.base = null_data;
+  vec.len = 2000;
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(ngtcp2_ringbuf_len(&conn->rx.path_challenge.rb) > 0);
+  spktlen = ngtcp2_conn_writev_datagram(
+      conn, NULL, NULL, buf, sizeof(buf), &accepted,
+      NGTCP2_WRITE_DATAGRAM_FLAG_NONE, 987, &vec, 1, ++t);
 
-  ngtcp2_path_storage_zero(&ps);
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(0 == accepted);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, &ps.path, NULL, buf, sizeof(buf), ++t);
+  spktlen = ngtcp2_conn_writev_datagram(
+      conn, NULL, NULL, buf, sizeof(buf), &accepted,
+      NGTCP2_WRITE_DATAGRAM_FLAG_NONE, 545, &vec, 1, ++t);
 
   CU_ASSERT(spktlen > 0);
-  CU_ASSERT(ngtcp2_path_eq(&new_path.path, &ps.path));
-  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->rx.path_challenge.rb));
-  CU_ASSERT(1 == ngtcp2_ringbuf_len(&conn->dcid.bound.rb));
+  CU_ASSERT(0 != accepted);
 
-  shdlen = ngtcp2_pkt_decode_hd_short(&hd, buf, (size_t)spktlen, cid.datalen);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(ngtcp2_cid_eq(&cid, &hd.dcid));
+  /* Calling ngtcp2_conn_writev_datagram without receiving positive
+     max_datagram_frame_size is an error */
+  setup_default_client(&conn);
+
+  spktlen = ngtcp2_conn_writev_datagram(
+      conn, NULL, NULL, buf, sizeof(buf), &accepted,
+      NGTCP2_WRITE_DATAGRAM_FLAG_NONE, 999, &datav, 1, ++t);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_STATE == spktlen);
+
+  ngtcp2_conn_del(conn);
+
+  /* Sending DATAGRAM which is larger than the value of received
+     max_datagram_frame_size is an error */
+  setup_default_client(&conn);
+  conn->remote.transport_params->max_datagram_frame_size = 9;
+
+  spktlen = ngtcp2_conn_writev_datagram(
+      conn, NULL, NULL, buf, sizeof(buf), &accepted,
+      NGTCP2_WRITE_DATAGRAM_FLAG_NONE, 4433, &datav, 1, ++t);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == spktlen);
+
+  ngtcp2_conn_del(conn);
+
+  /* Send DATAGRAM frame in a 0RTT packet */
+  setup_early_client(&conn);
+
+  conn->remote.transport_params->max_datagram_frame_size = 4311;
+
+  spktlen = ngtcp2_conn_writev_datagram(
+      conn, NULL, NULL, buf, sizeof(buf), &accepted,
+      NGTCP2_WRITE_DATAGRAM_FLAG_NONE, 22360679, &datav, 1, ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(0 != accepted);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_key_update(void) {
+void test_ngtcp2_conn_protect_pkts(void) {
   ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  size_t pktlen;
-  ngtcp2_ssize spktlen;
-  ngtcp2_tstamp t = 19393;
-  int64_t pkt_num = -1;
-  ngtcp2_frame fr;
+  uint8_t buf[2048], deferred_buf[4096];
+  uint8_t *p;
+  ngtcp2_ssize spktlen, nwrite;
+  ngtcp2_tstamp t = 0;
   int rv;
   int64_t stream_id;
-  ngtcp2_ssize nwrite;
-
-  setup_default_server(&conn);
-
-  /* The remote endpoint initiates key update */
-  fr.type = NGTCP2_FRAME_PING;
+  ngtcp2_vec datav = {null_data, 1024};
+  ngtcp2_ssize datalen, ref_datalen;
+  size_t i;
 
-  pktlen = write_single_frame_pkt_flags(
-      buf, sizeof(buf), NGTCP2_PKT_FLAG_KEY_PHASE, &conn->oscid, ++pkt_num, &fr,
-      conn->pktns.crypto.rx.ckm);
+  /* Write a packet without deferral for reference */
+  setup_default_client(&conn);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL != conn->crypto.key_update.old_rx_ckm);
-  CU_ASSERT(NULL == conn->crypto.key_update.new_tx_ckm);
-  CU_ASSERT(NULL == conn->crypto.key_update.new_rx_ckm);
-  CU_ASSERT(UINT64_MAX == conn->crypto.key_update.confirmed_ts);
-  CU_ASSERT(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_NOT_CONFIRMED);
-  CU_ASSERT(!(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_INITIATOR));
 
-  t += NGTCP2_SECONDS;
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), t);
+  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, 1200, &datalen,
+                                      NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                      &datav, 1, ++t);
 
   CU_ASSERT(spktlen > 0);
-  CU_ASSERT(t == conn->crypto.key_update.confirmed_ts);
-  CU_ASSERT(!(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_NOT_CONFIRMED));
-  CU_ASSERT(!(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_INITIATOR));
-
-  t += ngtcp2_conn_get_pto(conn) + 1;
+  CU_ASSERT(datalen > 0);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), t);
+  ref_datalen = datalen;
 
-  CU_ASSERT(0 == spktlen);
-  CU_ASSERT(NULL == conn->crypto.key_update.old_rx_ckm);
-  CU_ASSERT(NULL != conn->crypto.key_update.new_tx_ckm);
-  CU_ASSERT(NULL != conn->crypto.key_update.new_rx_ckm);
+  ngtcp2_conn_del(conn);
 
-  /* The local endpoint initiates key update */
-  t += ngtcp2_conn_get_pto(conn) * 2;
+  /* Deferred protection produces the same packets */
+  null_encrypt_batch_ncall = 0;
+  null_encrypt_batch_nop = 0;
+  t = 0;
 
-  rv = ngtcp2_conn_initiate_key_update(conn, t);
+  setup_default_client(&conn);
+  conn->callbacks.encrypt_batch = null_encrypt_batch;
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL != conn->crypto.key_update.old_rx_ckm);
-  CU_ASSERT(NULL == conn->crypto.key_update.new_tx_ckm);
-  CU_ASSERT(NULL == conn->crypto.key_update.new_rx_ckm);
-  CU_ASSERT(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_NOT_CONFIRMED);
-  CU_ASSERT(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_INITIATOR);
+  CU_ASSERT(NULL == conn->protect);
 
-  rv = ngtcp2_conn_open_uni_stream(conn, &stream_id, NULL);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
 
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
-                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
-                                     stream_id, null_data, 1024, ++t);
+  nwrite = ngtcp2_conn_writev_stream(conn, NULL, NULL, deferred_buf, 1200,
+                                     &datalen, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, &datav, 1, ++t);
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_NOT_CONFIRMED);
+  CU_ASSERT(spktlen == nwrite);
+  CU_ASSERT(ref_datalen == datalen);
+  CU_ASSERT(1 == conn->protect->len);
+  CU_ASSERT(0 == null_encrypt_batch_ncall);
 
-  fr.type = NGTCP2_FRAME_ACK;
-  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
-  fr.ack.ack_delay = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
+  rv = ngtcp2_conn_protect_pkts(conn);
 
-  pktlen = write_single_frame_pkt_flags(
-      buf, sizeof(buf), NGTCP2_PKT_FLAG_KEY_PHASE, &conn->oscid, ++pkt_num, &fr,
-      conn->pktns.crypto.rx.ckm);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == conn->protect->len);
+  CU_ASSERT(1 == null_encrypt_batch_ncall);
+  CU_ASSERT(1 == null_encrypt_batch_nop);
+  CU_ASSERT(0 == memcmp(buf, deferred_buf, (size_t)spktlen));
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  /* No pending packet */
+  rv = ngtcp2_conn_protect_pkts(conn);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(t == conn->crypto.key_update.confirmed_ts);
-  CU_ASSERT(!(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_NOT_CONFIRMED));
-  CU_ASSERT(!(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_INITIATOR));
+  CU_ASSERT(1 == null_encrypt_batch_ncall);
 
   ngtcp2_conn_del(conn);
-}
 
-void test_ngtcp2_conn_crypto_buffer_exceeded(void) {
-  ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  size_t pktlen;
-  ngtcp2_tstamp t = 11111;
-  int64_t pkt_num = -1;
-  ngtcp2_frame fr;
-  int rv;
+  /* Several packets are protected in one call */
+  null_encrypt_batch_ncall = 0;
+  null_encrypt_batch_nop = 0;
 
   setup_default_client(&conn);
+  conn->callbacks.encrypt_batch = null_encrypt_batch;
 
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 1000000;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].base = null_data;
-  fr.crypto.data[0].len = 1;
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  CU_ASSERT(0 == rv);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  p = deferred_buf;
 
-  CU_ASSERT(NGTCP2_ERR_CRYPTO_BUFFER_EXCEEDED == rv);
+  for (i = 0; i < 3; ++i) {
+    nwrite = ngtcp2_conn_writev_stream(
+        conn, NULL, NULL, p, 1200, &datalen, NGTCP2_WRITE_STREAM_FLAG_NONE,
+        stream_id, &datav, 1, ++t);
+
+    CU_ASSERT(nwrite > 0);
+
+    p += nwrite;
+  }
+
+  CU_ASSERT(3 == conn->protect->len);
+
+  rv = ngtcp2_conn_protect_pkts(conn);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == null_encrypt_batch_ncall);
+  CU_ASSERT(3 == null_encrypt_batch_nop);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_handshake_probe(void) {
+void test_ngtcp2_conn_protect_job(void) {
   ngtcp2_conn *conn;
+  uint8_t buf[2048], deferred_buf[2048], buf2[4096];
+  ngtcp2_ssize spktlen, nwrite;
   ngtcp2_tstamp t = 0;
-  ngtcp2_ssize spktlen;
-  size_t pktlen;
-  uint8_t buf[1200];
-  ngtcp2_frame fr;
-  ngtcp2_rtb_entry *ent;
-  ngtcp2_ksl_it it;
   int rv;
-  ngtcp2_crypto_aead_ctx aead_ctx = {0};
-  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
-  ngtcp2_crypto_ctx crypto_ctx;
+  int64_t stream_id;
+  int64_t pkt_num = -1;
+  ngtcp2_vec datav = {null_data, 1024};
+  ngtcp2_ssize datalen;
+  ngtcp2_protect_job *job;
+  ngtcp2_crypto_km *ckm;
+  ngtcp2_frame fr;
+  size_t pktlen;
 
-  /* Retransmit first Initial on PTO timer */
-  setup_handshake_client(&conn);
+  /* Write a packet without deferral for reference */
+  setup_default_client(&conn);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  spktlen = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf, 1200, &datalen,
+                                      NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                      &datav, 1, ++t);
 
   CU_ASSERT(spktlen > 0);
-  CU_ASSERT(1 == conn->in_pktns->rtb.num_ack_eliciting);
 
-  rv = ngtcp2_conn_on_loss_detection_timer(conn, ++t);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(1 == conn->in_pktns->rtb.probe_pkt_left);
+  /* Detached job produces the same packet */
+  null_encrypt_batch_ncall = 0;
+  null_encrypt_batch_nop = 0;
+  t = 0;
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  setup_default_client(&conn);
+  conn->callbacks.encrypt_batch = null_encrypt_batch;
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(1 == conn->in_pktns->rtb.num_retransmittable);
-  CU_ASSERT(2 == conn->in_pktns->rtb.num_ack_eliciting);
-  CU_ASSERT(0 == conn->in_pktns->rtb.probe_pkt_left);
+  rv = ngtcp2_conn_detach_protect_job(conn, &job);
 
-  fr.type = NGTCP2_FRAME_ACK;
-  fr.ack.largest_ack = 0;
-  fr.ack.ack_delay = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL == job);
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
-      ngtcp2_conn_get_dcid(conn), 0, NGTCP2_PROTO_VER_V1, &fr, &null_ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(1 == conn->in_pktns->rtb.num_ack_eliciting);
 
-  rv = ngtcp2_conn_on_loss_detection_timer(conn, ++t);
+  nwrite = ngtcp2_conn_writev_stream(conn, NULL, NULL, deferred_buf, 1200,
+                                     &datalen, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, &datav, 1, ++t);
+
+  CU_ASSERT(spktlen == nwrite);
+
+  rv = ngtcp2_conn_detach_protect_job(conn, &job);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(1 == conn->in_pktns->rtb.num_retransmittable);
-  CU_ASSERT(1 == conn->in_pktns->rtb.num_ack_eliciting);
-  CU_ASSERT(1 == conn->in_pktns->rtb.probe_pkt_left);
+  CU_ASSERT(NULL != job);
+  CU_ASSERT(job == conn->protect_jobs);
+  CU_ASSERT(1 == job->len);
+  CU_ASSERT(0 == conn->protect->len);
+  CU_ASSERT(0 == null_encrypt_batch_ncall);
 
-  /* This sends anti-deadlock padded Initial packet even if we have
-     nothing to send. */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  /* The connection keeps writing while the job is outstanding */
+  nwrite = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf2, 1200, &datalen,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     &datav, 1, ++t);
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(0 == conn->in_pktns->rtb.num_retransmittable);
-  CU_ASSERT(2 == conn->in_pktns->rtb.num_ack_eliciting);
-  CU_ASSERT(0 == conn->in_pktns->rtb.probe_pkt_left);
+  CU_ASSERT(nwrite > 0);
+  CU_ASSERT(1 == conn->protect->len);
 
-  it = ngtcp2_rtb_head(&conn->in_pktns->rtb);
-  ent = ngtcp2_ksl_it_get(&it);
+  /* Pending packets are not protected on the connection thread */
+  rv = ngtcp2_conn_protect_pkts(conn);
 
-  CU_ASSERT(ent->flags & NGTCP2_RTB_ENTRY_FLAG_PROBE);
-  CU_ASSERT(sizeof(buf) == ent->pktlen);
+  CU_ASSERT(NGTCP2_ERR_INVALID_STATE == rv);
+  CU_ASSERT(0 == null_encrypt_batch_ncall);
 
-  init_crypto_ctx(&crypto_ctx);
-  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
-  conn->negotiated_version = conn->client_chosen_version;
-  ngtcp2_conn_install_rx_handshake_key(conn, &aead_ctx, null_iv,
-                                       sizeof(null_iv), &hp_ctx);
-  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
-                                       sizeof(null_iv), &hp_ctx);
+  /* No more packets can be deferred */
+  conn->protect->len = NGTCP2_MAX_DEFERRED_PKTS;
 
-  rv = ngtcp2_conn_on_loss_detection_timer(conn, ++t);
+  nwrite = ngtcp2_conn_writev_stream(conn, NULL, NULL, buf2 + 1200, 1200,
+                                     &datalen, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, &datav, 1, ++t);
+
+  CU_ASSERT(0 == nwrite);
+
+  conn->protect->len = 1;
+
+  rv = ngtcp2_protect_job_run(job);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(2 == conn->in_pktns->rtb.num_ack_eliciting);
-  CU_ASSERT(1 == conn->hs_pktns->rtb.probe_pkt_left);
+  CU_ASSERT(1 == null_encrypt_batch_ncall);
+  CU_ASSERT(1 == null_encrypt_batch_nop);
+  CU_ASSERT(0 == memcmp(buf, deferred_buf, (size_t)spktlen));
 
-  /* This sends anti-deadlock Handshake packet even if we have nothing
-     to send. */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  ngtcp2_conn_release_protect_job(conn, job);
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(0 == conn->hs_pktns->rtb.num_retransmittable);
-  CU_ASSERT(1 == conn->hs_pktns->rtb.num_ack_eliciting);
-  CU_ASSERT(0 == conn->hs_pktns->rtb.probe_pkt_left);
+  CU_ASSERT(NULL == conn->protect_jobs);
 
-  it = ngtcp2_rtb_head(&conn->hs_pktns->rtb);
-  ent = ngtcp2_ksl_it_get(&it);
+  rv = ngtcp2_conn_protect_pkts(conn);
 
-  CU_ASSERT(ent->flags & NGTCP2_RTB_ENTRY_FLAG_PROBE);
-  CU_ASSERT(sizeof(buf) > ent->pktlen);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(2 == null_encrypt_batch_ncall);
 
   ngtcp2_conn_del(conn);
-}
 
-void test_ngtcp2_conn_handshake_loss(void) {
-  ngtcp2_conn *conn;
-  ngtcp2_tstamp t = 0;
-  ngtcp2_ssize spktlen;
-  size_t i;
-  size_t pktlen;
-  uint8_t buf[1252];
-  ngtcp2_frame fr;
-  ngtcp2_frame frs[2];
-  ngtcp2_cid rcid;
-  int rv;
-  int64_t pkt_num = -1;
-  ngtcp2_ksl_it it;
-  ngtcp2_rtb_entry *ent;
-
-  rcid_init(&rcid);
-  setup_handshake_server(&conn);
-  conn->callbacks.recv_crypto_data = recv_crypto_data;
-
-  frs[0].type = NGTCP2_FRAME_CRYPTO;
-  frs[0].crypto.offset = 0;
-  frs[0].crypto.datacnt = 1;
-  frs[0].crypto.data[0].len = 123;
-  frs[0].crypto.data[0].base = null_data;
-
-  frs[1].type = NGTCP2_FRAME_PADDING;
-  frs[1].padding.len = 1005;
+  /* The key is kept alive across key update until the job is
+     released. */
+  null_encrypt_batch_ncall = 0;
+  null_encrypt_batch_nop = 0;
 
-  pktlen = write_handshake_pkt(buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid,
-                               ngtcp2_conn_get_dcid(conn), ++pkt_num,
-                               conn->client_chosen_version, frs, 2, &null_ckm);
+  setup_default_server(&conn);
+  conn->callbacks.encrypt_batch = null_encrypt_batch;
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_conn_open_uni_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
 
-  /* Increase anti-amplification factor for easier testing */
-  conn->dcid.current.bytes_recv += 10000;
-
-  ngtcp2_conn_submit_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_INITIAL, null_data,
-                                 123);
-  ngtcp2_conn_submit_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_HANDSHAKE, null_data,
-                                 163);
-  ngtcp2_conn_submit_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_HANDSHAKE, null_data,
-                                 2369);
-  ngtcp2_conn_submit_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_HANDSHAKE, null_data,
-                                 79);
-  ngtcp2_conn_submit_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_HANDSHAKE, null_data,
-                                 36);
+  nwrite = ngtcp2_conn_writev_stream(conn, NULL, NULL, deferred_buf, 1200,
+                                     &datalen, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, &datav, 1, ++t);
 
-  /* Initial and first Handshake are coalesced into 1 packet. */
-  for (i = 0; i < 3; ++i) {
-    spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
-    CU_ASSERT(spktlen > 0);
-  }
+  CU_ASSERT(nwrite > 0);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  rv = ngtcp2_conn_detach_protect_job(conn, &job);
 
-  CU_ASSERT(0 == spktlen);
+  CU_ASSERT(0 == rv);
 
-  t += 1000;
+  ckm = conn->pktns.crypto.tx.ckm;
 
-  ngtcp2_conn_on_loss_detection_timer(conn, t);
+  fr.type = NGTCP2_FRAME_PING;
 
-  CU_ASSERT(1 == conn->in_pktns->rtb.probe_pkt_left);
-  CU_ASSERT(1 == conn->hs_pktns->rtb.probe_pkt_left);
+  pktlen = write_single_frame_pkt_flags(
+      buf, sizeof(buf), NGTCP2_PKT_FLAG_KEY_PHASE, &conn->oscid, ++pkt_num, &fr,
+      conn->pktns.crypto.rx.ckm);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(ckm != conn->pktns.crypto.tx.ckm);
+  CU_ASSERT(ckm == job->cc.ckm);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  rv = ngtcp2_protect_job_run(job);
 
-  CU_ASSERT(0 == spktlen);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == null_encrypt_batch_ncall);
 
-  it = ngtcp2_ksl_begin(&conn->hs_pktns->rtb.ents);
-  ent = ngtcp2_ksl_it_get(&it);
+  ngtcp2_conn_release_protect_job(conn, job);
 
-  CU_ASSERT(0 == ent->frc->fr.crypto.offset);
-  CU_ASSERT(987 == ngtcp2_vec_len(ent->frc->fr.crypto.data,
-                                  ent->frc->fr.crypto.datacnt));
-  CU_ASSERT(3 == ent->hd.pkt_num);
+  CU_ASSERT(NULL == conn->protect_jobs);
 
-  fr.type = NGTCP2_FRAME_ACK;
-  fr.ack.largest_ack = 2;
-  fr.ack.ack_delay = 0;
-  fr.ack.ack_delay_unscaled = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
+  /* Outstanding job is released by ngtcp2_conn_del. */
+  nwrite = ngtcp2_conn_writev_stream(conn, NULL, NULL, deferred_buf, 1200,
+                                     &datalen, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, &datav, 1, ++t);
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_HANDSHAKE, &conn->oscid,
-      ngtcp2_conn_get_dcid(conn), ++pkt_num, conn->client_chosen_version, &fr,
-      &null_ckm);
+  CU_ASSERT(nwrite > 0);
 
-  t += 8;
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, t);
+  rv = ngtcp2_conn_detach_protect_job(conn, &job);
 
   CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != job);
 
-  ngtcp2_conn_on_loss_detection_timer(conn, t);
+  ngtcp2_conn_del(conn);
+}
 
-  /* Retransmits the contents of lost packet */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+void test_ngtcp2_conn_prepare_rx_hp_masks(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[3][1200];
+  ngtcp2_vec pktv[3];
+  int64_t pkt_num = 0;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_frame fr;
+  size_t i;
+  int rv;
 
-  CU_ASSERT(spktlen > 0);
+  null_hp_mask_batch_ncall = 0;
+  null_hp_mask_batch_nsample = 0;
 
-  it = ngtcp2_ksl_begin(&conn->hs_pktns->rtb.ents);
-  ent = ngtcp2_ksl_it_get(&it);
+  setup_default_server(&conn);
+  conn->callbacks.hp_mask_batch = null_hp_mask_batch;
 
-  CU_ASSERT(NGTCP2_FRAME_CRYPTO == ent->frc->fr.type);
-  CU_ASSERT(987 == ent->frc->fr.crypto.offset);
-  CU_ASSERT(1 == ent->frc->fr.crypto.datacnt);
-  CU_ASSERT(1183 == ngtcp2_vec_len(ent->frc->fr.crypto.data,
-                                   ent->frc->fr.crypto.datacnt));
-  CU_ASSERT(4 == ent->hd.pkt_num);
+  fr.type = NGTCP2_FRAME_PING;
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  for (i = 0; i < 2; ++i) {
+    pktv[i].base = buf[i];
+    pktv[i].len = write_single_frame_pkt(buf[i], sizeof(buf[i]), &conn->oscid,
+                                         ++pkt_num, &fr,
+                                         conn->pktns.crypto.rx.ckm);
+  }
 
-  CU_ASSERT(0 == spktlen);
+  /* Long header packet is ignored. */
+  buf[2][0] = NGTCP2_HEADER_FORM_BIT;
+  pktv[2].base = buf[2];
+  pktv[2].len = sizeof(buf[2]);
 
-  t += 1000;
+  CU_ASSERT(NULL == conn->rx_hp);
 
-  ngtcp2_conn_on_loss_detection_timer(conn, t);
+  rv = ngtcp2_conn_prepare_rx_hp_masks(conn, pktv, 3);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == null_hp_mask_batch_ncall);
+  CU_ASSERT(2 == null_hp_mask_batch_nsample);
+  CU_ASSERT(2 == conn->rx_hp->len);
+  CU_ASSERT(0 == conn->rx_hp->pos);
 
-  CU_ASSERT(spktlen > 0);
+  for (i = 0; i < 2; ++i) {
+    rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, pktv[i].base,
+                              pktv[i].len, ++t);
 
-  it = ngtcp2_ksl_begin(&conn->hs_pktns->rtb.ents);
-  ent = ngtcp2_ksl_it_get(&it);
+    CU_ASSERT(0 == rv);
+    CU_ASSERT(i + 1 == conn->rx_hp->pos);
+  }
 
-  CU_ASSERT(NGTCP2_FRAME_CRYPTO == ent->frc->fr.type);
-  CU_ASSERT(0 == ent->frc->fr.crypto.offset);
-  CU_ASSERT(2 == ent->frc->fr.crypto.datacnt);
-  CU_ASSERT(987 == ngtcp2_vec_len(ent->frc->fr.crypto.data,
-                                  ent->frc->fr.crypto.datacnt));
-  CU_ASSERT(5 == ent->hd.pkt_num);
+  CU_ASSERT(2 == conn->pktns.rx.max_pkt_num);
 
-  ngtcp2_conn_del(conn);
+  ngtcp2_conn_hibernate(conn);
 
-  /* Retransmission splits CRYPTO frame */
-  setup_handshake_server(&conn);
-  conn->callbacks.recv_crypto_data = recv_crypto_data;
+  CU_ASSERT(NULL == conn->rx_hp);
 
-  frs[0].type = NGTCP2_FRAME_CRYPTO;
-  frs[0].crypto.offset = 0;
-  frs[0].crypto.datacnt = 1;
-  frs[0].crypto.data[0].len = 123;
-  frs[0].crypto.data[0].base = null_data;
+  ngtcp2_conn_del(conn);
+}
 
-  frs[1].type = NGTCP2_FRAME_PADDING;
-  frs[1].padding.len = 1005;
+void test_ngtcp2_conn_enqueue_datagram(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[1200];
+  ngtcp2_ssize spktlen;
+  ngtcp2_vec datav = {null_data, 10};
+  ngtcp2_vec vec;
+  my_user_data ud;
+  ngtcp2_rtb_entry *ent;
+  ngtcp2_rtb_it it;
+  ngtcp2_frame_chain *frc;
+  uint64_t dgram_id;
+  int rv;
 
-  pktlen = write_handshake_pkt(buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid,
-                               ngtcp2_conn_get_dcid(conn), ++pkt_num,
-                               conn->client_chosen_version, frs, 2, &null_ckm);
+  setup_default_client(&conn);
+  conn->callbacks.ack_datagram = ack_datagram;
+  conn->callbacks.lost_datagram = lost_datagram;
+  conn->remote.transport_params->max_datagram_frame_size = 65535;
+  conn->user_data = &ud;
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_conn_enqueue_datagram(conn, 1, &datav, 1, 1);
 
   CU_ASSERT(0 == rv);
 
-  /* Increase anti-amplification factor for easier testing */
-  conn->dcid.current.bytes_recv += 10000;
+  for (dgram_id = 2; dgram_id <= 4; ++dgram_id) {
+    rv = ngtcp2_conn_enqueue_datagram(conn, dgram_id, &datav, 1, UINT64_MAX);
 
-  ngtcp2_conn_submit_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_INITIAL, null_data,
-                                 123);
-  ngtcp2_conn_submit_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_HANDSHAKE, null_data,
-                                 3000);
-  /* Initial and first Handshake are coalesced into 1 packet. */
-  for (i = 0; i < 3; ++i) {
-    spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
-    CU_ASSERT(spktlen > 0);
+    CU_ASSERT(0 == rv);
   }
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
-
-  CU_ASSERT(0 == spktlen);
-
-  it = ngtcp2_ksl_begin(&conn->hs_pktns->rtb.ents);
-  ent = ngtcp2_ksl_it_get(&it);
-
-  CU_ASSERT(NGTCP2_FRAME_CRYPTO == ent->frc->fr.type);
-  CU_ASSERT(2170 == ent->frc->fr.crypto.offset);
-  CU_ASSERT(830 == ngtcp2_vec_len(ent->frc->fr.crypto.data,
-                                  ent->frc->fr.crypto.datacnt));
-  CU_ASSERT(2 == ent->hd.pkt_num);
+  CU_ASSERT(4 == ngtcp2_conn_get_datagram_queue_len(conn));
 
-  t += 1000;
+  ud.datagram.dgram_id = 0;
+  ud.datagram.nlost = 0;
 
-  ngtcp2_conn_on_loss_detection_timer(conn, t);
+  /* The expired DATAGRAM is dropped, and the rest are packed into a
+     single packet. */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 2);
 
-  /* 1st PTO */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
   CU_ASSERT(spktlen > 0);
+  CU_ASSERT(0 == ngtcp2_conn_get_datagram_queue_len(conn));
+  CU_ASSERT(1 == ud.datagram.nlost);
+  CU_ASSERT(1 == ud.datagram.dgram_id);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
-
-  CU_ASSERT(0 == spktlen);
-
-  it = ngtcp2_ksl_begin(&conn->hs_pktns->rtb.ents);
-  ent = ngtcp2_ksl_it_get(&it);
-
-  CU_ASSERT(NGTCP2_FRAME_CRYPTO == ent->frc->fr.type);
-  CU_ASSERT(0 == ent->frc->fr.crypto.offset);
-  CU_ASSERT(987 == ngtcp2_vec_len(ent->frc->fr.crypto.data,
-                                  ent->frc->fr.crypto.datacnt));
-  CU_ASSERT(3 == ent->hd.pkt_num);
+  it = ngtcp2_rtb_head(&conn->pktns.rtb);
+  ent = ngtcp2_rtb_it_get(&it);
 
-  t += 1000;
+  CU_ASSERT(ent->flags & NGTCP2_RTB_ENTRY_FLAG_DATAGRAM);
 
-  ngtcp2_conn_on_loss_detection_timer(conn, t);
+  dgram_id = 2;
+  for (frc = ent->frc; frc; frc = frc->next) {
+    if (frc->fr.type != NGTCP2_FRAME_DATAGRAM_LEN) {
+      continue;
+    }
 
-  /* 2nd PTO.  Initial and Handshake packets are coalesced.  Handshake
-     CRYPTO is split into 2 because of Initial CRYPTO. */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
-  CU_ASSERT(spktlen > 0);
+    CU_ASSERT(dgram_id == frc->fr.datagram.dgram_id);
+    ++dgram_id;
+  }
 
-  it = ngtcp2_ksl_begin(&conn->hs_pktns->rtb.ents);
-  ent = ngtcp2_ksl_it_get(&it);
+  CU_ASSERT(5 == dgram_id);
 
-  CU_ASSERT(NGTCP2_FRAME_CRYPTO == ent->frc->fr.type);
-  CU_ASSERT(987 == ent->frc->fr.crypto.offset);
-  CU_ASSERT(991 == ngtcp2_vec_len(ent->frc->fr.crypto.data,
-                                  ent->frc->fr.crypto.datacnt));
-  CU_ASSERT(4 == ent->hd.pkt_num);
+  /* DATAGRAM which never fits in a packet is dropped. */
+  vec.base = null_data;
+  vec.len = 2000;
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
-  CU_ASSERT(spktlen > 0);
+  rv = ngtcp2_conn_enqueue_datagram(conn, 5, &vec, 1, UINT64_MAX);
 
-  it = ngtcp2_ksl_begin(&conn->hs_pktns->rtb.ents);
-  ent = ngtcp2_ksl_it_get(&it);
+  CU_ASSERT(0 == rv);
 
-  CU_ASSERT(NGTCP2_FRAME_CRYPTO == ent->frc->fr.type);
-  CU_ASSERT(1978 == ent->frc->fr.crypto.offset);
-  CU_ASSERT(192 == ngtcp2_vec_len(ent->frc->fr.crypto.data,
-                                  ent->frc->fr.crypto.datacnt));
-  CU_ASSERT(5 == ent->hd.pkt_num);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 3);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
   CU_ASSERT(0 == spktlen);
+  CU_ASSERT(0 == ngtcp2_conn_get_datagram_queue_len(conn));
+  CU_ASSERT(2 == ud.datagram.nlost);
+  CU_ASSERT(5 == ud.datagram.dgram_id);
 
-  fr.type = NGTCP2_FRAME_ACK;
-  fr.ack.largest_ack = 0;
-  fr.ack.ack_delay = 0;
-  fr.ack.ack_delay_unscaled = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
+  /* Queued data is released without callback */
+  rv = ngtcp2_conn_enqueue_datagram(conn, 6, &datav, 1, UINT64_MAX);
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_HANDSHAKE, &conn->oscid,
-      ngtcp2_conn_get_dcid(conn), ++pkt_num, conn->client_chosen_version, &fr,
-      &null_ckm);
+  CU_ASSERT(0 == rv);
 
-  t += 8;
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, t);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(2 == ud.datagram.nlost);
 
-  t += 1000;
+  /* A remote endpoint does not support DATAGRAM */
+  setup_default_client(&conn);
 
-  ngtcp2_conn_on_loss_detection_timer(conn, t);
+  rv = ngtcp2_conn_enqueue_datagram(conn, 0, &datav, 1, UINT64_MAX);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  CU_ASSERT(NGTCP2_ERR_INVALID_STATE == rv);
 
-  CU_ASSERT(spktlen > 0);
+  ngtcp2_conn_del(conn);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
-  CU_ASSERT(0 == spktlen);
+  /* DATAGRAM is larger than max_datagram_frame_size */
+  setup_default_client(&conn);
+  conn->remote.transport_params->max_datagram_frame_size = 9;
 
-  it = ngtcp2_ksl_begin(&conn->hs_pktns->rtb.ents);
-  ent = ngtcp2_ksl_it_get(&it);
+  rv = ngtcp2_conn_enqueue_datagram(conn, 0, &datav, 1, UINT64_MAX);
 
-  CU_ASSERT(NGTCP2_FRAME_CRYPTO == ent->frc->fr.type);
-  CU_ASSERT(2170 == ent->frc->fr.crypto.offset);
-  CU_ASSERT(830 == ngtcp2_vec_len(ent->frc->fr.crypto.data,
-                                  ent->frc->fr.crypto.datacnt));
-  CU_ASSERT(6 == ent->hd.pkt_num);
-  CU_ASSERT(NULL == ent->frc->next);
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_recv_client_initial_retry(void) {
+void test_ngtcp2_conn_recv_datagram(void) {
   ngtcp2_conn *conn;
   uint8_t buf[2048];
-  size_t pktlen;
   ngtcp2_frame fr;
-  int64_t pkt_num = -1;
+  size_t pktlen;
+  int64_t pkt_num = 0;
   ngtcp2_tstamp t = 0;
-  ngtcp2_cid rcid;
+  my_user_data ud;
   int rv;
+  ngtcp2_cid rcid;
 
   rcid_init(&rcid);
 
-  setup_handshake_server(&conn);
+  setup_default_server(&conn);
+  conn->user_data = &ud;
+  conn->callbacks.recv_datagram = recv_datagram;
+  conn->local.transport_params.max_datagram_frame_size = 1 + 1111;
+
+  fr.type = NGTCP2_FRAME_DATAGRAM;
+  fr.datagram.data = fr.datagram.rdata;
+  fr.datagram.data->base = null_data;
+  fr.datagram.data->len = 1111;
+  fr.datagram.datacnt = 1;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+
+  memset(&ud, 0, sizeof(ud));
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1111 == ud.datagram.datalen);
+  CU_ASSERT(!(NGTCP2_DATAGRAM_FLAG_EARLY & ud.datagram.flags));
+
+  ngtcp2_conn_del(conn);
+
+  /* Receiving DATAGRAM frame which is strictly larger than the
+     declared limit is an error */
+  setup_default_server(&conn);
+  conn->local.transport_params.max_datagram_frame_size = 1 + 1111 - 1;
+
+  fr.type = NGTCP2_FRAME_DATAGRAM;
+  fr.datagram.data = fr.datagram.rdata;
+  fr.datagram.data->base = null_data;
+  fr.datagram.data->len = 1111;
+  fr.datagram.datacnt = 1;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(NGTCP2_ERR_PROTO == rv);
+
+  ngtcp2_conn_del(conn);
+
+  /* Receiving DATAGRAM frame in a 0RTT packet */
+  setup_early_server(&conn);
+  conn->user_data = &ud;
+  conn->callbacks.recv_datagram = recv_datagram;
+  conn->local.transport_params.max_datagram_frame_size = 1 + 1111;
+
   fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 1;
+  fr.crypto.offset = 0;
   fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 1245;
+  fr.crypto.data[0].len = 1199;
   fr.crypto.data[0].base = null_data;
 
   pktlen = write_single_frame_handshake_pkt(
@@ -6211,2873 +6602,7571 @@ void test_ngtcp2_conn_recv_client_initial_retry(void) {
 
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(NGTCP2_ERR_RETRY == rv);
+  CU_ASSERT(0 == rv);
+
+  fr.type = NGTCP2_FRAME_DATAGRAM;
+  fr.datagram.data = fr.datagram.rdata;
+  fr.datagram.data->base = null_data;
+  fr.datagram.data->len = 1111;
+  fr.datagram.datacnt = 1;
+
+  pktlen = write_single_frame_0rtt_pkt(
+      buf, sizeof(buf), &rcid, ngtcp2_conn_get_dcid(conn), ++pkt_num,
+      conn->client_chosen_version, &fr, &null_ckm);
+
+  memset(&ud, 0, sizeof(ud));
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1111 == ud.datagram.datalen);
+  CU_ASSERT(NGTCP2_DATAGRAM_FLAG_EARLY & ud.datagram.flags);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_recv_client_initial_token(void) {
+void test_ngtcp2_conn_recv_ack_frequency(void) {
   ngtcp2_conn *conn;
   uint8_t buf[2048];
-  size_t pktlen;
   ngtcp2_frame fr;
-  int64_t pkt_num = -1;
+  size_t pktlen;
+  int64_t pkt_num = 0;
   ngtcp2_tstamp t = 0;
-  ngtcp2_cid rcid;
   int rv;
-  const uint8_t raw_token[] = {0xff, 0x12, 0x31, 0x04, 0xab};
-  ngtcp2_vec token;
-  const ngtcp2_mem *mem;
 
-  rcid_init(&rcid);
+  setup_default_server(&conn);
+  conn->local.transport_params.min_ack_delay = NGTCP2_MILLISECONDS;
 
-  setup_handshake_server(&conn);
-  mem = conn->mem;
+  fr.type = NGTCP2_FRAME_ACK_FREQUENCY;
+  fr.ack_frequency.seq = 1;
+  fr.ack_frequency.ack_eliciting_threshold = 9;
+  fr.ack_frequency.request_max_ack_delay = 10000;
+  fr.ack_frequency.reordering_threshold = 0;
 
-  token.base = ngtcp2_mem_malloc(mem, sizeof(raw_token));
-  memcpy(token.base, raw_token, sizeof(raw_token));
-  token.len = sizeof(raw_token);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  conn->local.settings.token = token;
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 1181;
-  fr.crypto.data[0].base = null_data;
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(2 == conn->rx.ack_freq.next_seq);
+  CU_ASSERT(10 == conn->rx.ack_freq.ack_thresh);
+  CU_ASSERT(10 * NGTCP2_MILLISECONDS == conn->rx.ack_freq.max_ack_delay);
+  CU_ASSERT(0 == conn->rx.ack_freq.reordering_thresh);
 
-  pktlen = write_single_frame_initial_pkt(
-      buf, sizeof(buf), &rcid, ngtcp2_conn_get_dcid(conn), ++pkt_num,
-      conn->client_chosen_version, &fr, raw_token, sizeof(raw_token),
-      &null_ckm);
+  /* ACK_FREQUENCY with an old sequence number is ignored. */
+  fr.ack_frequency.seq = 0;
+  fr.ack_frequency.ack_eliciting_threshold = 1;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(1181 == ngtcp2_strm_rx_offset(&conn->in_pktns->crypto.strm));
+  CU_ASSERT(2 == conn->rx.ack_freq.next_seq);
+  CU_ASSERT(10 == conn->rx.ack_freq.ack_thresh);
+
+  /* IMMEDIATE_ACK makes local endpoint acknowledge immediately. */
+  conn->pktns.acktr.flags &= (uint16_t)~NGTCP2_ACKTR_FLAG_IMMEDIATE_ACK;
+  fr.type = NGTCP2_FRAME_IMMEDIATE_ACK;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(conn->pktns.acktr.flags & NGTCP2_ACKTR_FLAG_IMMEDIATE_ACK);
 
   ngtcp2_conn_del(conn);
 
-  /* Specifying invalid token lets server drop the packet */
-  setup_handshake_server(&conn);
-  mem = conn->mem;
+  /* Requested max_ack_delay must not be less than min_ack_delay. */
+  setup_default_server(&conn);
+  conn->local.transport_params.min_ack_delay = NGTCP2_MILLISECONDS;
 
-  token.base = ngtcp2_mem_malloc(mem, sizeof(raw_token));
-  memcpy(token.base, raw_token, sizeof(raw_token));
-  token.len = sizeof(raw_token) - 1;
+  fr.type = NGTCP2_FRAME_ACK_FREQUENCY;
+  fr.ack_frequency.seq = 0;
+  fr.ack_frequency.ack_eliciting_threshold = 9;
+  fr.ack_frequency.request_max_ack_delay = 999;
+  fr.ack_frequency.reordering_threshold = 1;
 
-  conn->local.settings.token = token;
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 1179;
-  fr.crypto.data[0].base = null_data;
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  pktlen = write_single_frame_initial_pkt(
-      buf, sizeof(buf), &rcid, ngtcp2_conn_get_dcid(conn), ++pkt_num,
-      conn->client_chosen_version, &fr, raw_token, sizeof(raw_token),
-      &null_ckm);
+  CU_ASSERT(NGTCP2_ERR_PROTO == rv);
+
+  ngtcp2_conn_del(conn);
+
+  /* Receiving ACK_FREQUENCY without advertising min_ack_delay is an
+     error. */
+  setup_default_server(&conn);
+
+  fr.ack_frequency.request_max_ack_delay = 10000;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
   rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(NGTCP2_ERR_DROP_CONN == rv);
-  CU_ASSERT(0 == ngtcp2_strm_rx_offset(&conn->in_pktns->crypto.strm));
+  CU_ASSERT(NGTCP2_ERR_PROTO == rv);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_get_active_dcid(void) {
-  ngtcp2_conn *conn;
-  ngtcp2_cid_token cid_token[2];
-  ngtcp2_cid dcid;
-  static uint8_t token[] = {0xf1, 0xf1, 0xf1, 0xf1, 0xf1, 0xf1, 0xf1, 0xf1,
-                            0xf1, 0xf1, 0xf1, 0xf1, 0xf1, 0xf1, 0xf1, 0xf1};
+static int recv_ce_pkt(ngtcp2_conn *conn, int64_t pkt_num, uint8_t ecn,
+                       ngtcp2_tstamp ts) {
+  uint8_t buf[2048];
+  ngtcp2_frame fr;
+  size_t pktlen;
+  ngtcp2_pkt_info pi = {
+    .ecn = ecn,
+  };
 
-  dcid_init(&dcid);
-  setup_default_client(&conn);
+  conn->pktns.acktr.flags &= (uint16_t)~NGTCP2_ACKTR_FLAG_IMMEDIATE_ACK;
 
-  CU_ASSERT(1 == ngtcp2_conn_get_num_active_dcid(conn));
-  CU_ASSERT(1 == ngtcp2_conn_get_active_dcid(conn, cid_token));
-  CU_ASSERT(0 == cid_token[0].seq);
-  CU_ASSERT(ngtcp2_cid_eq(&dcid, &cid_token[0].cid));
-  CU_ASSERT(ngtcp2_path_eq(&null_path.path, &cid_token[0].ps.path));
-  CU_ASSERT(1 == cid_token[0].token_present);
-  CU_ASSERT(0 ==
-            memcmp(token, cid_token[0].token, NGTCP2_STATELESS_RESET_TOKENLEN));
+  fr.type = NGTCP2_FRAME_PING;
 
-  ngtcp2_conn_del(conn);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+
+  return ngtcp2_conn_read_pkt(conn, &null_path.path, &pi, buf, pktlen, ts);
 }
 
-void test_ngtcp2_conn_recv_version_negotiation(void) {
+void test_ngtcp2_conn_recv_ecn_ce(void) {
   ngtcp2_conn *conn;
-  const ngtcp2_cid *dcid;
-  ngtcp2_ssize spktlen;
-  uint8_t buf[1500];
-  uint32_t nsv[3];
-  int rv;
+  ngtcp2_settings settings;
+  int64_t pkt_num = -1;
   ngtcp2_tstamp t = 0;
+  int rv;
 
-  setup_handshake_client(&conn);
-
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
-
-  CU_ASSERT(spktlen > 0);
+  /* Every CE marked packet is acknowledged immediately by default. */
+  setup_default_server(&conn);
+  conn->rx.ack_freq.ack_thresh = 100;
 
-  dcid = ngtcp2_conn_get_dcid(conn);
+  rv = recv_ce_pkt(conn, ++pkt_num, NGTCP2_ECN_CE, ++t);
 
-  nsv[0] = 0xffffffff;
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(conn->pktns.acktr.flags & NGTCP2_ACKTR_FLAG_IMMEDIATE_ACK);
+  CU_ASSERT(1 == conn->pktns.rx.ecn.ce);
 
-  spktlen = ngtcp2_pkt_write_version_negotiation(
-      buf, sizeof(buf), 0xfe, conn->oscid.data, conn->oscid.datalen, dcid->data,
-      dcid->datalen, nsv, 1);
+  rv = recv_ce_pkt(conn, ++pkt_num, NGTCP2_ECN_CE, ++t);
 
-  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(conn->pktns.acktr.flags & NGTCP2_ACKTR_FLAG_IMMEDIATE_ACK);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
-                            (size_t)spktlen, ++t);
+  rv = recv_ce_pkt(conn, ++pkt_num, NGTCP2_ECN_ECT_1, ++t);
 
-  CU_ASSERT(NGTCP2_ERR_RECV_VERSION_NEGOTIATION == rv);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(!(conn->pktns.acktr.flags & NGTCP2_ACKTR_FLAG_IMMEDIATE_ACK));
 
   ngtcp2_conn_del(conn);
 
-  /* Ignore Version Negotiation if it contains version selected by
-     client */
-  setup_handshake_client(&conn);
+  /* With ack_ce_on_change, only the start and the end of CE marking
+     are acknowledged immediately. */
+  server_default_settings(&settings);
+  settings.ack_ce_on_change = 1;
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  setup_default_server_settings(&conn, &settings);
+  conn->rx.ack_freq.ack_thresh = 100;
+  pkt_num = -1;
 
-  CU_ASSERT(spktlen > 0);
+  rv = recv_ce_pkt(conn, ++pkt_num, NGTCP2_ECN_ECT_1, ++t);
 
-  dcid = ngtcp2_conn_get_dcid(conn);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(!(conn->pktns.acktr.flags & NGTCP2_ACKTR_FLAG_IMMEDIATE_ACK));
 
-  nsv[0] = 0xfffffff0;
-  nsv[1] = conn->client_chosen_version;
+  rv = recv_ce_pkt(conn, ++pkt_num, NGTCP2_ECN_CE, ++t);
 
-  spktlen = ngtcp2_pkt_write_version_negotiation(
-      buf, sizeof(buf), 0x50, conn->oscid.data, conn->oscid.datalen, dcid->data,
-      dcid->datalen, nsv, 2);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(conn->pktns.acktr.flags & NGTCP2_ACKTR_FLAG_IMMEDIATE_ACK);
 
-  CU_ASSERT(spktlen > 0);
+  rv = recv_ce_pkt(conn, ++pkt_num, NGTCP2_ECN_CE, ++t);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
-                            (size_t)spktlen, ++t);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(!(conn->pktns.acktr.flags & NGTCP2_ACKTR_FLAG_IMMEDIATE_ACK));
+  CU_ASSERT(2 == conn->pktns.rx.ecn.ce);
+
+  rv = recv_ce_pkt(conn, ++pkt_num, NGTCP2_ECN_ECT_1, ++t);
 
   CU_ASSERT(0 == rv);
+  CU_ASSERT(conn->pktns.acktr.flags & NGTCP2_ACKTR_FLAG_IMMEDIATE_ACK);
 
   ngtcp2_conn_del(conn);
+}
 
-  /* Ignore Version Negotiation if client reacted upon Version
-     Negotiation */
-  setup_handshake_client(&conn);
+static int recv_spin_pkt(ngtcp2_conn *conn, int64_t pkt_num, uint8_t flags,
+                         ngtcp2_tstamp ts) {
+  uint8_t buf[2048];
+  ngtcp2_frame fr;
+  size_t pktlen;
 
-  conn->local.settings.original_version = NGTCP2_PROTO_VER_V2_DRAFT;
+  fr.type = NGTCP2_FRAME_PING;
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  pktlen =
+      write_single_frame_pkt_flags(buf, sizeof(buf), flags, &conn->oscid,
+                                   pkt_num, &fr, conn->pktns.crypto.rx.ckm);
 
-  CU_ASSERT(spktlen > 0);
+  return ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ts);
+}
 
-  dcid = ngtcp2_conn_get_dcid(conn);
+void test_ngtcp2_conn_spin_bit(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_settings settings;
+  uint8_t buf[2048];
+  ngtcp2_ssize spktlen;
+  ngtcp2_tstamp t = 0;
+  int rv;
 
-  nsv[0] = 0xffffffff;
+  /* The spin bit is disabled for a connection at random even if it
+     is enabled by settings.  genrand makes it happen. */
+  server_default_settings(&settings);
+  settings.spin_bit = 1;
 
-  spktlen = ngtcp2_pkt_write_version_negotiation(
-      buf, sizeof(buf), 0xfe, conn->oscid.data, conn->oscid.datalen, dcid->data,
-      dcid->datalen, nsv, 1);
+  setup_default_server_settings(&conn, &settings);
 
-  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(!(conn->flags & NGTCP2_CONN_FLAG_SPIN_BIT));
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
-                            (size_t)spktlen, ++t);
+  rv = recv_spin_pkt(conn, 0, NGTCP2_PKT_FLAG_SPIN_BIT, ++t);
 
   CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == conn->spin.value);
 
   ngtcp2_conn_del(conn);
-}
 
-void test_ngtcp2_conn_send_initial_token(void) {
-  ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  ngtcp2_callbacks cb;
-  ngtcp2_settings settings;
-  ngtcp2_transport_params params;
-  ngtcp2_cid rcid, scid;
-  ngtcp2_crypto_aead retry_aead = {0, NGTCP2_FAKE_AEAD_OVERHEAD};
-  uint8_t token[] = "this is token";
-  ngtcp2_ssize spktlen, shdlen;
-  ngtcp2_tstamp t = 0;
-  ngtcp2_pkt_hd hd;
-  ngtcp2_crypto_aead_ctx aead_ctx = {0};
-  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
-  ngtcp2_crypto_ctx crypto_ctx;
-
-  rcid_init(&rcid);
-  scid_init(&scid);
+  /* Server echoes the spin value of the packet which has the largest
+     packet number. */
+  setup_default_server_settings(&conn, &settings);
+  conn->flags |= NGTCP2_CONN_FLAG_SPIN_BIT;
+  conn->spin.dcid_seq = conn->dcid.current.seq;
 
-  init_initial_crypto_ctx(&crypto_ctx);
-
-  client_default_callbacks(&cb);
-  client_default_settings(&settings);
-  client_default_transport_params(&params);
-
-  settings.token.base = token;
-  settings.token.len = sizeof(token);
+  rv = recv_spin_pkt(conn, 0, NGTCP2_PKT_FLAG_SPIN_BIT, ++t);
 
-  ngtcp2_conn_client_new(&conn, &rcid, &scid, &null_path.path,
-                         NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
-                         /* mem = */ NULL, NULL);
-  ngtcp2_conn_set_initial_crypto_ctx(conn, &crypto_ctx);
-  ngtcp2_conn_install_initial_key(conn, &aead_ctx, null_iv, &hp_ctx, &aead_ctx,
-                                  null_iv, &hp_ctx, sizeof(null_iv));
-  ngtcp2_conn_set_retry_aead(conn, &retry_aead, &aead_ctx);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == conn->spin.value);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf),
+                                  t + NGTCP2_SECONDS);
 
   CU_ASSERT(spktlen > 0);
+  CU_ASSERT(buf[0] & NGTCP2_SHORT_SPIN_BIT_MASK);
 
-  shdlen = ngtcp2_pkt_decode_hd_long(&hd, buf, (size_t)spktlen);
+  rv = recv_spin_pkt(conn, 2, NGTCP2_PKT_FLAG_NONE, ++t);
 
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(sizeof(token) == hd.token.len);
-  CU_ASSERT(0 == memcmp(token, hd.token.base, sizeof(token)));
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == conn->spin.value);
 
-  ngtcp2_conn_del(conn);
-}
+  /* Reordered packet does not change the spin value. */
+  rv = recv_spin_pkt(conn, 1, NGTCP2_PKT_FLAG_SPIN_BIT, ++t);
 
-void test_ngtcp2_conn_set_remote_transport_params(void) {
-  ngtcp2_conn *conn;
-  ngtcp2_transport_params params;
-  int rv;
-  ngtcp2_cid dcid;
-  uint8_t other_versions[2 * sizeof(uint32_t)];
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == conn->spin.value);
 
-  dcid_init(&dcid);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf),
+                                  t + NGTCP2_SECONDS);
 
-  /* client: Successful case */
-  setup_handshake_client(&conn);
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(!(buf[0] & NGTCP2_SHORT_SPIN_BIT_MASK));
 
-  conn->negotiated_version = conn->client_chosen_version;
+  ngtcp2_conn_del(conn);
 
-  memset(&params, 0, sizeof(params));
-  params.active_connection_id_limit = NGTCP2_DEFAULT_ACTIVE_CONNECTION_ID_LIMIT;
-  params.max_udp_payload_size = 1450;
-  params.initial_scid = conn->dcid.current.cid;
-  params.original_dcid = conn->rcid;
+  /* Client inverts the spin value. */
+  setup_default_client(&conn);
+  conn->flags |= NGTCP2_CONN_FLAG_SPIN_BIT;
+  conn->spin.dcid_seq = conn->dcid.current.seq;
 
-  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+  rv = recv_spin_pkt(conn, 0, NGTCP2_PKT_FLAG_NONE, ++t);
 
   CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == conn->spin.value);
 
-  ngtcp2_conn_del(conn);
+  rv = recv_spin_pkt(conn, 1, NGTCP2_PKT_FLAG_SPIN_BIT, ++t);
 
-  /* client: Wrong original_dcid */
-  setup_handshake_client(&conn);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == conn->spin.value);
 
-  conn->negotiated_version = conn->client_chosen_version;
+  ngtcp2_conn_del(conn);
+}
 
-  memset(&params, 0, sizeof(params));
-  params.active_connection_id_limit = NGTCP2_DEFAULT_ACTIVE_CONNECTION_ID_LIMIT;
-  params.max_udp_payload_size = 1450;
-  params.initial_scid = conn->dcid.current.cid;
+void test_ngtcp2_conn_fec(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  uint8_t data[3][100];
+  uint8_t repair[100];
+  ngtcp2_frame fr;
+  size_t pktlen;
+  ngtcp2_ssize spktlen;
+  ngtcp2_ssize nwrite;
+  int64_t pkt_num = 0;
+  ngtcp2_tstamp t = 0;
+  int64_t stream_id;
+  ngtcp2_strm *strm;
+  size_t i;
+  int rv;
 
-  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+  memset(data[0], 'a', sizeof(data[0]));
+  memset(data[1], 'b', sizeof(data[1]));
+  memset(data[2], 'c', sizeof(data[2]));
 
-  CU_ASSERT(NGTCP2_ERR_TRANSPORT_PARAM == rv);
+  /* Recover a lost STREAM frame from REPAIR frame. */
+  setup_default_server(&conn);
+  conn->local.transport_params.fec_window = 65536;
+  conn->remote.transport_params->fec_window = 65536;
 
-  ngtcp2_conn_del(conn);
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.flags = 0;
+  fr.stream.fin = 0;
+  fr.stream.stream_id = 4;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].base = data[0];
+  fr.stream.data[0].len = sizeof(data[0]);
 
-  /* client: Wrong initial_scid */
-  setup_handshake_client(&conn);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  conn->negotiated_version = conn->client_chosen_version;
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  memset(&params, 0, sizeof(params));
-  params.active_connection_id_limit = NGTCP2_DEFAULT_ACTIVE_CONNECTION_ID_LIMIT;
-  params.max_udp_payload_size = 1450;
-  params.original_dcid = conn->rcid;
+  CU_ASSERT(0 == rv);
 
-  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+  /* The second STREAM frame is lost, and the third is 50 bytes
+     long. */
+  fr.stream.offset = 200;
+  fr.stream.data[0].base = data[2];
+  fr.stream.data[0].len = 50;
 
-  CU_ASSERT(NGTCP2_ERR_TRANSPORT_PARAM == rv);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  ngtcp2_conn_del(conn);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  /* client: Receiving retry_scid when retry is not attempted */
-  setup_handshake_client(&conn);
+  CU_ASSERT(0 == rv);
 
-  conn->negotiated_version = conn->client_chosen_version;
+  strm = ngtcp2_conn_find_stream(conn, 4);
 
-  memset(&params, 0, sizeof(params));
-  params.active_connection_id_limit = NGTCP2_DEFAULT_ACTIVE_CONNECTION_ID_LIMIT;
-  params.max_udp_payload_size = 1450;
-  params.initial_scid = conn->dcid.current.cid;
-  params.original_dcid = conn->rcid;
-  params.retry_scid_present = 1;
+  CU_ASSERT(100 == ngtcp2_strm_rx_offset(strm));
 
-  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+  for (i = 0; i < sizeof(repair); ++i) {
+    repair[i] = (uint8_t)(data[0][i] ^ data[1][i] ^ (i < 50 ? data[2][i] : 0));
+  }
 
-  CU_ASSERT(NGTCP2_ERR_TRANSPORT_PARAM == rv);
+  fr.type = NGTCP2_FRAME_REPAIR;
+  fr.repair.stream_id = 4;
+  fr.repair.offset = 0;
+  fr.repair.symbolcnt = 3;
+  fr.repair.symbollen[0] = 100;
+  fr.repair.symbollen[1] = 100;
+  fr.repair.symbollen[2] = 50;
+  fr.repair.data.base = repair;
+  fr.repair.data.len = sizeof(repair);
 
-  ngtcp2_conn_del(conn);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  /* client: Receiving retry_scid */
-  setup_handshake_client(&conn);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  conn->flags |= NGTCP2_CONN_FLAG_RECV_RETRY;
-  conn->retry_scid = dcid;
-  conn->negotiated_version = conn->client_chosen_version;
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(250 == ngtcp2_strm_rx_offset(strm));
+  CU_ASSERT(1 == conn->cstat.fec_recovered_count);
 
-  memset(&params, 0, sizeof(params));
-  params.active_connection_id_limit = NGTCP2_DEFAULT_ACTIVE_CONNECTION_ID_LIMIT;
-  params.max_udp_payload_size = 1450;
-  params.initial_scid = conn->dcid.current.cid;
-  params.original_dcid = conn->rcid;
-  params.retry_scid_present = 1;
-  params.retry_scid = dcid;
+  /* REPAIR frame is ignored if nothing is lost. */
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == conn->cstat.fec_recovered_count);
 
   ngtcp2_conn_del(conn);
 
-  /* client: Not receiving retry_scid when retry is attempted */
-  setup_handshake_client(&conn);
-
-  conn->flags |= NGTCP2_CONN_FLAG_RECV_RETRY;
-  conn->retry_scid = dcid;
-  conn->negotiated_version = conn->client_chosen_version;
+  /* Receiving REPAIR frame without advertising fec_window is an
+     error. */
+  setup_default_server(&conn);
 
-  memset(&params, 0, sizeof(params));
-  params.active_connection_id_limit = NGTCP2_DEFAULT_ACTIVE_CONNECTION_ID_LIMIT;
-  params.max_udp_payload_size = 1450;
-  params.initial_scid = conn->dcid.current.cid;
-  params.original_dcid = conn->rcid;
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(NGTCP2_ERR_TRANSPORT_PARAM == rv);
+  CU_ASSERT(NGTCP2_ERR_PROTO == rv);
 
   ngtcp2_conn_del(conn);
 
-  /* client: No version_information after Version Negotiation */
-  setup_handshake_client(&conn);
-
-  conn->local.settings.original_version = NGTCP2_PROTO_VER_V2_DRAFT;
-  conn->negotiated_version = conn->client_chosen_version;
-
-  memset(&params, 0, sizeof(params));
-  params.active_connection_id_limit = NGTCP2_DEFAULT_ACTIVE_CONNECTION_ID_LIMIT;
-  params.max_udp_payload_size = 1450;
-  params.initial_scid = conn->dcid.current.cid;
-  params.original_dcid = conn->rcid;
+  /* Send REPAIR frame after the data passed to the library have been
+     written. */
+  setup_default_client(&conn);
 
-  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
-  CU_ASSERT(NGTCP2_ERR_VERSION_NEGOTIATION_FAILURE == rv);
+  CU_ASSERT(0 == rv);
 
-  ngtcp2_conn_del(conn);
+  rv = ngtcp2_conn_set_stream_fec(conn, stream_id, 4);
 
-  /* client: other_versions includes the version that the client
-     initially attempted. */
-  setup_handshake_client(&conn);
+  CU_ASSERT(NGTCP2_ERR_INVALID_STATE == rv);
 
-  conn->local.settings.original_version = NGTCP2_PROTO_VER_V2_DRAFT;
-  conn->negotiated_version = conn->client_chosen_version;
+  conn->local.transport_params.fec_window = 65536;
+  conn->remote.transport_params->fec_window = 65536;
 
-  ngtcp2_put_uint32be(other_versions, NGTCP2_PROTO_VER_V1);
-  ngtcp2_put_uint32be(other_versions + sizeof(uint32_t),
-                      NGTCP2_PROTO_VER_V2_DRAFT);
+  rv = ngtcp2_conn_set_stream_fec(conn, stream_id,
+                                  NGTCP2_MAX_FEC_SYMBOLCNT + 1);
 
-  memset(&params, 0, sizeof(params));
-  params.active_connection_id_limit = NGTCP2_DEFAULT_ACTIVE_CONNECTION_ID_LIMIT;
-  params.max_udp_payload_size = 1450;
-  params.initial_scid = conn->dcid.current.cid;
-  params.original_dcid = conn->rcid;
-  params.version_info_present = 1;
-  params.version_info.chosen_version = conn->negotiated_version;
-  params.version_info.other_versions = other_versions;
-  params.version_info.other_versionslen = 2 * sizeof(uint32_t);
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
 
-  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+  rv = ngtcp2_conn_set_stream_fec(conn, stream_id, 4);
 
-  CU_ASSERT(NGTCP2_ERR_VERSION_NEGOTIATION_FAILURE == rv);
+  CU_ASSERT(0 == rv);
 
-  ngtcp2_conn_del(conn);
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, null_data, 3000, ++t);
 
-  /* client: client is unable to choose client chosen version from
-     server's other_versions and chosen version. */
-  setup_handshake_client(&conn);
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(nwrite > 0);
+  CU_ASSERT(nwrite < 3000);
+  CU_ASSERT(NULL == conn->tx.repairq);
 
-  conn->local.settings.original_version = NGTCP2_PROTO_VER_V2_DRAFT;
-  conn->negotiated_version = 0xff000000u;
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
 
-  conn->local.settings.preferred_versions[0] = 0xff000001u;
-  conn->local.settings.preferred_versionslen = 1;
+  CU_ASSERT(1 == strm->tx.fec->symbolcnt);
 
-  ngtcp2_put_uint32be(conn->vneg.other_versions, NGTCP2_PROTO_VER_V1);
-  ngtcp2_put_uint32be(conn->vneg.other_versions + sizeof(uint32_t),
-                      0xff000000u);
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, null_data, 100, ++t);
 
-  ngtcp2_put_uint32be(other_versions, 0xff000000u);
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(100 == nwrite);
+  CU_ASSERT(NULL != conn->tx.repairq);
+  CU_ASSERT(0 == strm->tx.fec->symbolcnt);
+  CU_ASSERT(2 == conn->tx.repairq->fr.repair.symbolcnt);
 
-  memset(&params, 0, sizeof(params));
-  params.active_connection_id_limit = NGTCP2_DEFAULT_ACTIVE_CONNECTION_ID_LIMIT;
-  params.max_udp_payload_size = 1450;
-  params.initial_scid = conn->dcid.current.cid;
-  params.original_dcid = conn->rcid;
-  params.version_info_present = 1;
-  params.version_info.chosen_version = conn->negotiated_version;
-  params.version_info.other_versions = other_versions;
-  params.version_info.other_versionslen = 1;
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(NULL == conn->tx.repairq);
 
-  CU_ASSERT(NGTCP2_ERR_VERSION_NEGOTIATION_FAILURE == rv);
+  /* REPAIR frame is not sent if all data it protects have been
+     acknowledged. */
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, null_data, 100, ++t);
 
-  ngtcp2_conn_del(conn);
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(NULL != conn->tx.repairq);
 
-  /* client: client chooses version which differs from client chosen
-     version from server's other_versions and chosen version. */
-  setup_handshake_client(&conn);
+  rv = ngtcp2_strm_ack_data(strm, 0, strm->tx.offset);
 
-  conn->local.settings.original_version = NGTCP2_PROTO_VER_V2_DRAFT;
-  conn->negotiated_version = 0xff000000u;
+  CU_ASSERT(0 == rv);
 
-  conn->local.settings.preferred_versions[0] = 0xff000000u;
-  conn->local.settings.preferred_versionslen = 1;
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  ngtcp2_put_uint32be(conn->vneg.other_versions, NGTCP2_PROTO_VER_V1);
-  ngtcp2_put_uint32be(conn->vneg.other_versions + sizeof(uint32_t),
-                      0xff000000u);
+  CU_ASSERT(0 == spktlen);
+  CU_ASSERT(NULL == conn->tx.repairq);
 
-  ngtcp2_put_uint32be(other_versions, 0xff000000u);
+  ngtcp2_conn_del(conn);
+}
 
-  memset(&params, 0, sizeof(params));
-  params.active_connection_id_limit = NGTCP2_DEFAULT_ACTIVE_CONNECTION_ID_LIMIT;
-  params.max_udp_payload_size = 1450;
-  params.initial_scid = conn->dcid.current.cid;
-  params.original_dcid = conn->rcid;
-  params.version_info_present = 1;
-  params.version_info.chosen_version = conn->negotiated_version;
-  params.version_info.other_versions = other_versions;
-  params.version_info.other_versionslen = 1;
+void test_ngtcp2_conn_recv_new_connection_id(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_ssize spktlen;
+  ngtcp2_tstamp t = 0;
+  int64_t pkt_num = 0;
+  ngtcp2_frame fr;
+  ngtcp2_frame frs[16];
+  const uint8_t cid[] = {0xf0, 0xf1, 0xf2, 0xf3};
+  const uint8_t token[NGTCP2_STATELESS_RESET_TOKENLEN] = {0xff};
+  const uint8_t cid2[] = {0xf0, 0xf1, 0xf2, 0xf4};
+  const uint8_t token2[NGTCP2_STATELESS_RESET_TOKENLEN] = {0xfe};
+  const uint8_t cid3[] = {0xf0, 0xf1, 0xf2, 0xf5};
+  const uint8_t token3[NGTCP2_STATELESS_RESET_TOKENLEN] = {0xfd};
+  ngtcp2_dcid *dcid;
+  int rv;
+  ngtcp2_frame_chain *frc;
+  size_t i;
 
-  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+  setup_default_client(&conn);
 
-  CU_ASSERT(NGTCP2_ERR_VERSION_NEGOTIATION_FAILURE == rv);
+  /* This will send NEW_CONNECTION_ID frames */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  ngtcp2_conn_del(conn);
-}
+  CU_ASSERT(spktlen > 0);
 
-void test_ngtcp2_conn_write_connection_close(void) {
-  ngtcp2_conn *conn;
-  uint8_t buf[1200];
-  ngtcp2_ssize spktlen, shdlen;
-  ngtcp2_pkt_hd hd;
-  const uint8_t *p;
-  ngtcp2_crypto_aead_ctx aead_ctx = {0};
-  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
-  ngtcp2_crypto_ctx crypto_ctx;
-  ngtcp2_connection_close_error ccerr;
+  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  fr.new_connection_id.seq = 1;
+  fr.new_connection_id.retire_prior_to = 0;
+  ngtcp2_cid_init(&fr.new_connection_id.cid, cid, sizeof(cid));
+  memcpy(fr.new_connection_id.stateless_reset_token, token, sizeof(token));
 
-  /* Client only Initial key */
-  setup_handshake_client(&conn);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 0);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
 
-  ngtcp2_connection_close_error_set_transport_error(&ccerr, NGTCP2_NO_ERROR,
-                                                    (const uint8_t *)"foo", 3);
+  assert(ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
+  dcid = ngtcp2_ringbuf_get(&conn->dcid.unused.rb, 0);
 
-  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
-                                               sizeof(buf), &ccerr, 0);
+  CU_ASSERT(ngtcp2_cid_eq(&fr.new_connection_id.cid, &dcid->cid));
+  CU_ASSERT(dcid->flags & NGTCP2_DCID_FLAG_TOKEN_PRESENT);
+  CU_ASSERT(0 == memcmp(fr.new_connection_id.stateless_reset_token, dcid->token,
+                        sizeof(fr.new_connection_id.stateless_reset_token)));
 
-  CU_ASSERT(spktlen >= NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  fr.new_connection_id.seq = 2;
+  fr.new_connection_id.retire_prior_to = 2;
+  ngtcp2_cid_init(&fr.new_connection_id.cid, cid2, sizeof(cid2));
+  memcpy(fr.new_connection_id.stateless_reset_token, token2, sizeof(token2));
 
-  shdlen = ngtcp2_pkt_decode_hd_long(&hd, buf, (size_t)spktlen);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_INITIAL == hd.type);
-  CU_ASSERT(shdlen + (ngtcp2_ssize)hd.len == spktlen);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  ngtcp2_conn_del(conn);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.bound.rb));
+  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
+  CU_ASSERT(2 == conn->dcid.current.seq);
+  CU_ASSERT(NULL != conn->pktns.tx.frq);
+  CU_ASSERT(2 == conn->dcid.retire_prior_to);
 
-  /* Client has Initial and Handshake keys */
-  setup_handshake_client(&conn);
+  frc = conn->pktns.tx.frq;
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 0);
+  CU_ASSERT(NGTCP2_FRAME_RETIRE_CONNECTION_ID == frc->fr.type);
 
-  CU_ASSERT(spktlen > 0);
+  frc = frc->next;
 
-  init_crypto_ctx(&crypto_ctx);
+  CU_ASSERT(NGTCP2_FRAME_RETIRE_CONNECTION_ID == frc->fr.type);
+  CU_ASSERT(NULL == frc->next);
 
-  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
-  conn->negotiated_version = conn->client_chosen_version;
-  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
-                                       sizeof(null_iv), &hp_ctx);
+  /* This will send RETIRE_CONNECTION_ID frames */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  ngtcp2_connection_close_error_set_transport_error_liberr(&ccerr, 0, NULL, 0);
+  CU_ASSERT(spktlen > 0);
 
-  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
-                                               sizeof(buf), &ccerr, 0);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+  /* Received connection ID is immediately retired due to packet
+     reordering */
+  setup_default_client(&conn);
 
-  shdlen = ngtcp2_pkt_decode_hd_long(&hd, buf, (size_t)spktlen);
+  /* This will send NEW_CONNECTION_ID frames */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_HANDSHAKE == hd.type);
-  CU_ASSERT(shdlen + (ngtcp2_ssize)hd.len == spktlen);
+  CU_ASSERT(spktlen > 0);
 
-  ngtcp2_conn_del(conn);
+  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  fr.new_connection_id.seq = 2;
+  fr.new_connection_id.retire_prior_to = 2;
+  ngtcp2_cid_init(&fr.new_connection_id.cid, cid, sizeof(cid));
+  memcpy(fr.new_connection_id.stateless_reset_token, token, sizeof(token));
 
-  /* Client has all keys and has not confirmed handshake */
-  setup_handshake_client(&conn);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  init_crypto_ctx(&crypto_ctx);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
-  conn->negotiated_version = conn->client_chosen_version;
-  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
-                                       sizeof(null_iv), &hp_ctx);
-  ngtcp2_conn_install_tx_key(conn, null_secret, sizeof(null_secret), &aead_ctx,
-                             null_iv, sizeof(null_iv), &hp_ctx);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
+  CU_ASSERT(2 == conn->dcid.current.seq);
+  CU_ASSERT(2 == conn->dcid.retire_prior_to);
 
-  conn->state = NGTCP2_CS_POST_HANDSHAKE;
+  frc = conn->pktns.tx.frq;
 
-  ngtcp2_connection_close_error_set_transport_error(&ccerr, NGTCP2_NO_ERROR,
-                                                    NULL, 0);
+  CU_ASSERT(NGTCP2_FRAME_RETIRE_CONNECTION_ID == frc->fr.type);
+  CU_ASSERT(NULL == frc->next);
 
-  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
-                                               sizeof(buf), &ccerr, 0);
+  /* This will send RETIRE_CONNECTION_ID frames */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
   CU_ASSERT(spktlen > 0);
-  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
 
-  p = buf;
+  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  fr.new_connection_id.seq = 1;
+  fr.new_connection_id.retire_prior_to = 0;
+  ngtcp2_cid_init(&fr.new_connection_id.cid, cid2, sizeof(cid2));
+  memcpy(fr.new_connection_id.stateless_reset_token, token2, sizeof(token2));
 
-  shdlen = ngtcp2_pkt_decode_hd_long(&hd, p, (size_t)spktlen);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_HANDSHAKE == hd.type);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  p += shdlen + (ngtcp2_ssize)hd.len;
-  spktlen -= shdlen + (ngtcp2_ssize)hd.len;
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
+  CU_ASSERT(2 == conn->dcid.current.seq);
+  CU_ASSERT(2 == conn->dcid.retire_prior_to);
 
-  shdlen = ngtcp2_pkt_decode_hd_short(&hd, p, (size_t)spktlen,
-                                      conn->dcid.current.cid.datalen);
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_1RTT == hd.type);
+  frc = conn->pktns.tx.frq;
 
-  ngtcp2_conn_del(conn);
+  CU_ASSERT(NGTCP2_FRAME_RETIRE_CONNECTION_ID == frc->fr.type);
+  CU_ASSERT(NULL == frc->next);
 
-  /* Client has confirmed handshake */
-  setup_default_client(&conn);
+  ngtcp2_conn_del(conn);
 
-  ngtcp2_connection_close_error_set_transport_error(&ccerr, NGTCP2_NO_ERROR,
-                                                    NULL, 0);
+  /* ngtcp2_pv contains DCIDs that should be retired. */
+  setup_default_server(&conn);
 
-  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
-                                               sizeof(buf), &ccerr, 0);
+  /* This will send NEW_CONNECTION_ID frames */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
   CU_ASSERT(spktlen > 0);
-  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
-
-  shdlen = ngtcp2_pkt_decode_hd_short(&hd, buf, (size_t)spktlen,
-                                      conn->dcid.current.cid.datalen);
 
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_1RTT == hd.type);
+  assert(NULL == conn->pv);
 
-  ngtcp2_conn_del(conn);
+  frs[0].type = NGTCP2_FRAME_PING;
+  frs[1].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  frs[1].new_connection_id.seq = 1;
+  frs[1].new_connection_id.retire_prior_to = 0;
+  ngtcp2_cid_init(&frs[1].new_connection_id.cid, cid, sizeof(cid));
+  memcpy(frs[1].new_connection_id.stateless_reset_token, token, sizeof(token));
+  frs[2].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  frs[2].new_connection_id.seq = 2;
+  frs[2].new_connection_id.retire_prior_to = 0;
+  ngtcp2_cid_init(&frs[2].new_connection_id.cid, cid2, sizeof(cid2));
+  memcpy(frs[2].new_connection_id.stateless_reset_token, token2,
+         sizeof(token2));
+  frs[3].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  frs[3].new_connection_id.seq = 3;
+  frs[3].new_connection_id.retire_prior_to = 0;
+  ngtcp2_cid_init(&frs[3].new_connection_id.cid, cid3, sizeof(cid3));
+  memcpy(frs[3].new_connection_id.stateless_reset_token, token3,
+         sizeof(token3));
 
-  /* Server has Initial and Handshake key */
-  setup_handshake_server(&conn);
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 4,
+                     conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
 
-  conn->dcid.current.bytes_recv = NGTCP2_MAX_UDP_PAYLOAD_SIZE;
+  CU_ASSERT(0 == rv);
 
-  init_initial_crypto_ctx(&crypto_ctx);
+  assert(NULL != conn->pv);
 
-  ngtcp2_conn_set_initial_crypto_ctx(conn, &crypto_ctx);
-  ngtcp2_conn_install_initial_key(conn, &aead_ctx, null_iv, &hp_ctx, &aead_ctx,
-                                  null_iv, &hp_ctx, sizeof(null_iv));
+  CU_ASSERT(conn->pv->flags & NGTCP2_PV_FLAG_FALLBACK_ON_FAILURE);
+  CU_ASSERT(1 == conn->pv->dcid.seq);
+  CU_ASSERT(0 == conn->pv->fallback_dcid.seq);
+  CU_ASSERT(2 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
 
-  init_crypto_ctx(&crypto_ctx);
+  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  fr.new_connection_id.seq = 3;
+  fr.new_connection_id.retire_prior_to = 2;
+  ngtcp2_cid_init(&fr.new_connection_id.cid, cid3, sizeof(cid3));
+  memcpy(fr.new_connection_id.stateless_reset_token, token3, sizeof(token3));
 
-  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
-  conn->negotiated_version = conn->client_chosen_version;
-  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
-                                       sizeof(null_iv), &hp_ctx);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  ngtcp2_connection_close_error_set_transport_error(&ccerr, NGTCP2_NO_ERROR,
-                                                    NULL, 0);
+  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
 
-  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
-                                               sizeof(buf), &ccerr, 0);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
+  CU_ASSERT(conn->pv->flags & NGTCP2_PV_FLAG_FALLBACK_ON_FAILURE);
+  CU_ASSERT(2 == conn->pv->dcid.seq);
+  CU_ASSERT(3 == conn->pv->fallback_dcid.seq);
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+  frc = conn->pktns.tx.frq;
 
-  p = buf;
+  CU_ASSERT(NGTCP2_FRAME_RETIRE_CONNECTION_ID == frc->fr.type);
+  CU_ASSERT(0 == frc->fr.retire_connection_id.seq);
+  frc = frc->next;
 
-  shdlen = ngtcp2_pkt_decode_hd_long(&hd, p, (size_t)spktlen);
-
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_INITIAL == hd.type);
-
-  p += shdlen + (ngtcp2_ssize)hd.len;
-  spktlen -= shdlen + (ngtcp2_ssize)hd.len;
-
-  shdlen = ngtcp2_pkt_decode_hd_long(&hd, p, (size_t)spktlen);
-
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_HANDSHAKE == hd.type);
-  CU_ASSERT(shdlen + (ngtcp2_ssize)hd.len == spktlen);
+  CU_ASSERT(NGTCP2_FRAME_RETIRE_CONNECTION_ID == frc->fr.type);
+  CU_ASSERT(1 == frc->fr.retire_connection_id.seq);
+  CU_ASSERT(NULL == frc->next);
 
   ngtcp2_conn_del(conn);
 
-  /* Server has all keys and has not confirmed handshake */
-  setup_handshake_server(&conn);
-
-  conn->dcid.current.bytes_recv = NGTCP2_MAX_UDP_PAYLOAD_SIZE;
-
-  init_initial_crypto_ctx(&crypto_ctx);
+  /* ngtcp2_pv contains DCID in fallback that should be retired and
+     there is not enough connection ID left.  */
+  setup_default_server(&conn);
 
-  ngtcp2_conn_set_initial_crypto_ctx(conn, &crypto_ctx);
-  ngtcp2_conn_install_initial_key(conn, &aead_ctx, null_iv, &hp_ctx, &aead_ctx,
-                                  null_iv, &hp_ctx, sizeof(null_iv));
+  /* This will send NEW_CONNECTION_ID frames */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  init_crypto_ctx(&crypto_ctx);
+  CU_ASSERT(spktlen > 0);
 
-  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
-  conn->negotiated_version = conn->client_chosen_version;
-  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
-                                       sizeof(null_iv), &hp_ctx);
-  ngtcp2_conn_install_tx_key(conn, null_secret, sizeof(null_secret), &aead_ctx,
-                             null_iv, sizeof(null_iv), &hp_ctx);
+  assert(NULL == conn->pv);
 
-  conn->state = NGTCP2_CS_POST_HANDSHAKE;
+  frs[0].type = NGTCP2_FRAME_PING;
+  frs[1].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  frs[1].new_connection_id.seq = 1;
+  frs[1].new_connection_id.retire_prior_to = 0;
+  ngtcp2_cid_init(&frs[1].new_connection_id.cid, cid, sizeof(cid));
+  memcpy(frs[1].new_connection_id.stateless_reset_token, token, sizeof(token));
 
-  ngtcp2_connection_close_error_set_transport_error(&ccerr, NGTCP2_NO_ERROR,
-                                                    NULL, 0);
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 2,
+                     conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
 
-  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
-                                               sizeof(buf), &ccerr, 0);
+  CU_ASSERT(0 == rv);
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+  assert(NULL != conn->pv);
 
-  p = buf;
+  CU_ASSERT(conn->pv->flags & NGTCP2_PV_FLAG_FALLBACK_ON_FAILURE);
+  CU_ASSERT(1 == conn->pv->dcid.seq);
+  CU_ASSERT(0 == conn->pv->fallback_dcid.seq);
+  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
 
-  shdlen = ngtcp2_pkt_decode_hd_long(&hd, p, (size_t)spktlen);
+  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  fr.new_connection_id.seq = 2;
+  fr.new_connection_id.retire_prior_to = 2;
+  ngtcp2_cid_init(&fr.new_connection_id.cid, cid2, sizeof(cid2));
+  memcpy(fr.new_connection_id.stateless_reset_token, token2, sizeof(token2));
 
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_INITIAL == hd.type);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  p += shdlen + (ngtcp2_ssize)hd.len;
-  spktlen -= shdlen + (ngtcp2_ssize)hd.len;
+  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
 
-  shdlen = ngtcp2_pkt_decode_hd_long(&hd, p, (size_t)spktlen);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(2 == conn->dcid.current.seq);
+  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
+  CU_ASSERT(NULL == conn->pv);
 
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_HANDSHAKE == hd.type);
+  frc = conn->pktns.tx.frq;
 
-  p += shdlen + (ngtcp2_ssize)hd.len;
-  spktlen -= shdlen + (ngtcp2_ssize)hd.len;
+  CU_ASSERT(NGTCP2_FRAME_RETIRE_CONNECTION_ID == frc->fr.type);
+  CU_ASSERT(0 == frc->fr.retire_connection_id.seq);
 
-  shdlen = ngtcp2_pkt_decode_hd_short(&hd, p, (size_t)spktlen,
-                                      conn->dcid.current.cid.datalen);
+  frc = frc->next;
 
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_1RTT == hd.type);
+  CU_ASSERT(NGTCP2_FRAME_RETIRE_CONNECTION_ID == frc->fr.type);
+  CU_ASSERT(1 == frc->fr.retire_connection_id.seq);
+  CU_ASSERT(NULL == frc->next);
 
   ngtcp2_conn_del(conn);
 
-  /* Server has confirmed handshake */
+  /* ngtcp2_pv contains DCIDs that should be retired and there is not
+     enough connection ID left to continue path validation.  */
   setup_default_server(&conn);
 
-  ngtcp2_connection_close_error_set_transport_error(&ccerr, NGTCP2_NO_ERROR,
-                                                    NULL, 0);
-
-  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
-                                               sizeof(buf), &ccerr, 0);
+  /* This will send NEW_CONNECTION_ID frames */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
   CU_ASSERT(spktlen > 0);
-  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
-
-  shdlen = ngtcp2_pkt_decode_hd_short(&hd, buf, (size_t)spktlen,
-                                      conn->dcid.current.cid.datalen);
-
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_1RTT == hd.type);
 
-  ngtcp2_conn_del(conn);
-}
+  assert(NULL == conn->pv);
 
-void test_ngtcp2_conn_write_application_close(void) {
-  ngtcp2_conn *conn;
-  uint8_t buf[1200];
-  ngtcp2_ssize spktlen, shdlen;
-  ngtcp2_pkt_hd hd;
-  const uint8_t *p;
-  ngtcp2_crypto_aead_ctx aead_ctx = {0};
-  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
-  uint64_t app_err_code = 0;
-  ngtcp2_crypto_ctx crypto_ctx;
-  ngtcp2_connection_close_error ccerr;
+  frs[0].type = NGTCP2_FRAME_PING;
+  frs[1].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  frs[1].new_connection_id.seq = 1;
+  frs[1].new_connection_id.retire_prior_to = 0;
+  ngtcp2_cid_init(&frs[1].new_connection_id.cid, cid, sizeof(cid));
+  memcpy(frs[1].new_connection_id.stateless_reset_token, token, sizeof(token));
 
-  /* Client only Initial key */
-  setup_handshake_client(&conn);
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 2,
+                     conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 0);
+  CU_ASSERT(0 == rv);
 
-  CU_ASSERT(spktlen > 0);
+  assert(NULL != conn->pv);
 
-  ngtcp2_connection_close_error_set_application_error(
-      &ccerr, app_err_code, (const uint8_t *)"foo", 3);
+  CU_ASSERT(conn->pv->flags & NGTCP2_PV_FLAG_FALLBACK_ON_FAILURE);
+  CU_ASSERT(1 == conn->pv->dcid.seq);
+  CU_ASSERT(0 == conn->pv->fallback_dcid.seq);
+  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
 
-  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
-                                               sizeof(buf), &ccerr, 0);
+  /* Overwrite seq in pv->dcid so that pv->dcid cannot be renewed. */
+  conn->pv->dcid.seq = 2;
+  /* Internally we assume that if primary dcid and pv->dcid differ,
+     then no fallback dcid is present. */
+  conn->pv->flags &= (uint8_t)~NGTCP2_PV_FLAG_FALLBACK_ON_FAILURE;
 
-  CU_ASSERT(spktlen >= NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  fr.new_connection_id.seq = 3;
+  fr.new_connection_id.retire_prior_to = 3;
+  ngtcp2_cid_init(&fr.new_connection_id.cid, cid3, sizeof(cid3));
+  memcpy(fr.new_connection_id.stateless_reset_token, token3, sizeof(token3));
 
-  shdlen = ngtcp2_pkt_decode_hd_long(&hd, buf, (size_t)spktlen);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_INITIAL == hd.type);
-  CU_ASSERT(shdlen + (ngtcp2_ssize)hd.len == spktlen);
+  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
 
-  ngtcp2_conn_del(conn);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(3 == conn->dcid.current.seq);
+  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
+  CU_ASSERT(NULL == conn->pv);
 
-  /* Client has Initial and Handshake keys */
-  setup_handshake_client(&conn);
+  frc = conn->pktns.tx.frq;
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 0);
+  CU_ASSERT(NGTCP2_FRAME_RETIRE_CONNECTION_ID == frc->fr.type);
+  CU_ASSERT(2 == frc->fr.retire_connection_id.seq);
 
-  CU_ASSERT(spktlen > 0);
+  frc = frc->next;
 
-  init_crypto_ctx(&crypto_ctx);
+  CU_ASSERT(NGTCP2_FRAME_RETIRE_CONNECTION_ID == frc->fr.type);
+  CU_ASSERT(1 == frc->fr.retire_connection_id.seq);
+  CU_ASSERT(NULL == frc->next);
 
-  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
-  conn->negotiated_version = conn->client_chosen_version;
-  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
-                                       sizeof(null_iv), &hp_ctx);
+  ngtcp2_conn_del(conn);
 
-  ngtcp2_connection_close_error_set_application_error(&ccerr, app_err_code,
-                                                      NULL, 0);
+  /* Receiving more than advertised CID is treated as error */
+  setup_default_server(&conn);
+  conn->local.transport_params.active_connection_id_limit = 2;
 
-  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
-                                               sizeof(buf), &ccerr, 0);
+  /* This will send NEW_CONNECTION_ID frames */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
   CU_ASSERT(spktlen > 0);
-  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
-
-  shdlen = ngtcp2_pkt_decode_hd_long(&hd, buf, (size_t)spktlen);
-
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_HANDSHAKE == hd.type);
-  CU_ASSERT(shdlen + (ngtcp2_ssize)hd.len == spktlen);
 
-  ngtcp2_conn_del(conn);
+  assert(NULL == conn->pv);
 
-  /* Client has all keys and has not confirmed handshake */
-  setup_handshake_client(&conn);
+  frs[0].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  frs[0].new_connection_id.seq = 1;
+  frs[0].new_connection_id.retire_prior_to = 0;
+  ngtcp2_cid_init(&frs[0].new_connection_id.cid, cid, sizeof(cid));
+  memcpy(frs[0].new_connection_id.stateless_reset_token, token, sizeof(token));
+  frs[1].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  frs[1].new_connection_id.seq = 2;
+  frs[1].new_connection_id.retire_prior_to = 0;
+  ngtcp2_cid_init(&frs[1].new_connection_id.cid, cid2, sizeof(cid2));
+  memcpy(frs[1].new_connection_id.stateless_reset_token, token2,
+         sizeof(token2));
+  frs[2].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  frs[2].new_connection_id.seq = 3;
+  frs[2].new_connection_id.retire_prior_to = 0;
+  ngtcp2_cid_init(&frs[2].new_connection_id.cid, cid3, sizeof(cid3));
+  memcpy(frs[2].new_connection_id.stateless_reset_token, token3,
+         sizeof(token3));
 
-  init_crypto_ctx(&crypto_ctx);
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 3,
+                     conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
 
-  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
-  conn->negotiated_version = conn->client_chosen_version;
-  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
-                                       sizeof(null_iv), &hp_ctx);
-  ngtcp2_conn_install_tx_key(conn, null_secret, sizeof(null_secret), &aead_ctx,
-                             null_iv, sizeof(null_iv), &hp_ctx);
+  CU_ASSERT(NGTCP2_ERR_CONNECTION_ID_LIMIT == rv);
 
-  conn->state = NGTCP2_CS_POST_HANDSHAKE;
+  ngtcp2_conn_del(conn);
 
-  ngtcp2_connection_close_error_set_application_error(&ccerr, app_err_code,
-                                                      NULL, 0);
+  /* Receiving duplicated NEW_CONNECTION_ID frame */
+  setup_default_server(&conn);
 
-  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
-                                               sizeof(buf), &ccerr, 0);
+  /* This will send NEW_CONNECTION_ID frames */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
   CU_ASSERT(spktlen > 0);
-  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
 
-  p = buf;
+  frs[0].type = NGTCP2_FRAME_PING;
 
-  shdlen = ngtcp2_pkt_decode_hd_long(&hd, p, (size_t)spktlen);
+  frs[1].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  frs[1].new_connection_id.seq = 1;
+  frs[1].new_connection_id.retire_prior_to = 1;
+  ngtcp2_cid_init(&frs[1].new_connection_id.cid, cid, sizeof(cid));
+  memcpy(frs[1].new_connection_id.stateless_reset_token, token, sizeof(token));
 
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_HANDSHAKE == hd.type);
+  frs[2].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  frs[2].new_connection_id.seq = 2;
+  frs[2].new_connection_id.retire_prior_to = 1;
+  ngtcp2_cid_init(&frs[2].new_connection_id.cid, cid2, sizeof(cid2));
+  memcpy(frs[2].new_connection_id.stateless_reset_token, token2,
+         sizeof(token2));
 
-  p += shdlen + (ngtcp2_ssize)hd.len;
-  spktlen -= shdlen + (ngtcp2_ssize)hd.len;
+  frs[3].type = NGTCP2_FRAME_PADDING;
+  frs[3].padding.len = 1200;
 
-  shdlen = ngtcp2_pkt_decode_hd_short(&hd, p, (size_t)spktlen,
-                                      conn->dcid.current.cid.datalen);
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_1RTT == hd.type);
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 4,
+                     conn->pktns.crypto.rx.ckm);
 
-  ngtcp2_conn_del(conn);
+  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
 
-  /* Client has confirmed handshake */
-  setup_default_client(&conn);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
+  CU_ASSERT(2 == conn->dcid.current.seq);
+  CU_ASSERT(NULL != conn->pv);
+  CU_ASSERT(ngtcp2_cid_eq(&frs[1].new_connection_id.cid,
+                          &conn->pv->fallback_dcid.cid));
 
-  ngtcp2_connection_close_error_set_application_error(&ccerr, app_err_code,
-                                                      NULL, 0);
+  /* This will send PATH_CHALLENGE frame */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
-                                               sizeof(buf), &ccerr, 0);
+  CU_ASSERT(spktlen >= 1200);
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+  fr.type = NGTCP2_FRAME_PATH_RESPONSE;
+  memset(fr.path_response.data, 0, sizeof(fr.path_response.data));
 
-  shdlen = ngtcp2_pkt_decode_hd_short(&hd, buf, (size_t)spktlen,
-                                      conn->dcid.current.cid.datalen);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_1RTT == hd.type);
+  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
 
-  ngtcp2_conn_del(conn);
+  CU_ASSERT(0 == rv);
+  /* Server starts probing old path */
+  CU_ASSERT(NULL != conn->pv);
+  CU_ASSERT(ngtcp2_path_eq(&null_path.path, &conn->pv->dcid.ps.path));
 
-  /* Server has Initial and Handshake key */
-  setup_handshake_server(&conn);
+  /* Receive NEW_CONNECTION_ID seq=1 again, which should be ignored. */
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 2,
+                     conn->pktns.crypto.rx.ckm);
 
-  conn->dcid.current.bytes_recv = NGTCP2_MAX_UDP_PAYLOAD_SIZE;
+  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
 
-  init_initial_crypto_ctx(&crypto_ctx);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.unused.rb));
+  CU_ASSERT(2 == conn->dcid.current.seq);
 
-  ngtcp2_conn_set_initial_crypto_ctx(conn, &crypto_ctx);
-  ngtcp2_conn_install_initial_key(conn, &aead_ctx, null_iv, &hp_ctx, &aead_ctx,
-                                  null_iv, &hp_ctx, sizeof(null_iv));
+  ngtcp2_conn_del(conn);
 
-  init_crypto_ctx(&crypto_ctx);
+  /* Exceeding the limit for the number of unacknowledged
+     RETIRE_CONNECTION_ID leads to NGTCP2_ERR_CONNECTION_ID_LIMIT. */
+  setup_default_server(&conn);
 
-  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
-  conn->negotiated_version = conn->client_chosen_version;
-  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
-                                       sizeof(null_iv), &hp_ctx);
+  /* This will send NEW_CONNECTION_ID frames */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  ngtcp2_connection_close_error_set_application_error(&ccerr, app_err_code,
-                                                      NULL, 0);
+  CU_ASSERT(spktlen > 0);
 
-  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
-                                               sizeof(buf), &ccerr, 0);
+  for (i = 0; i < 7; ++i) {
+    frs[i].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+    frs[i].new_connection_id.seq = i + 1;
+    frs[i].new_connection_id.retire_prior_to = 0;
+    ngtcp2_cid_init(&frs[i].new_connection_id.cid, cid, sizeof(cid));
+    frs[i].new_connection_id.cid.data[0] = (uint8_t)i;
+    memcpy(frs[i].new_connection_id.stateless_reset_token, token,
+           sizeof(token));
+  }
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 7,
+                     conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  p = buf;
+  CU_ASSERT(0 == rv);
 
-  shdlen = ngtcp2_pkt_decode_hd_long(&hd, p, (size_t)spktlen);
+  for (i = 0; i < 8; ++i) {
+    frs[i].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+    frs[i].new_connection_id.seq = i + 8;
+    frs[i].new_connection_id.retire_prior_to = 8;
+    ngtcp2_cid_init(&frs[i].new_connection_id.cid, cid, sizeof(cid));
+    frs[i].new_connection_id.cid.data[0] = (uint8_t)(i + 8);
+    memcpy(frs[i].new_connection_id.stateless_reset_token, token,
+           sizeof(token));
+  }
 
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_INITIAL == hd.type);
+  for (i = 0; i < 8; ++i) {
+    frs[i + 8].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+    frs[i + 8].new_connection_id.seq = i + 16;
+    frs[i + 8].new_connection_id.retire_prior_to = 16;
+    ngtcp2_cid_init(&frs[i + 8].new_connection_id.cid, cid, sizeof(cid));
+    frs[i + 8].new_connection_id.cid.data[0] = (uint8_t)(i + 16);
+    memcpy(frs[i + 8].new_connection_id.stateless_reset_token, token,
+           sizeof(token));
+  }
 
-  p += shdlen + (ngtcp2_ssize)hd.len;
-  spktlen -= shdlen + (ngtcp2_ssize)hd.len;
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 16,
+                     conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  shdlen = ngtcp2_pkt_decode_hd_long(&hd, p, (size_t)spktlen);
+  CU_ASSERT(0 == rv);
 
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_HANDSHAKE == hd.type);
-  CU_ASSERT(shdlen + (ngtcp2_ssize)hd.len == spktlen);
+  frs[0].type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  frs[0].new_connection_id.seq = 24;
+  frs[0].new_connection_id.retire_prior_to = 17;
+  ngtcp2_cid_init(&frs[0].new_connection_id.cid, cid, sizeof(cid));
+  frs[0].new_connection_id.cid.data[0] = (uint8_t)(i + 24);
+  memcpy(frs[0].new_connection_id.stateless_reset_token, token, sizeof(token));
 
-  ngtcp2_conn_del(conn);
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 1,
+                     conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  /* Server has all keys and has not confirmed handshake */
-  setup_handshake_server(&conn);
+  CU_ASSERT(NGTCP2_ERR_CONNECTION_ID_LIMIT == rv);
 
-  conn->dcid.current.bytes_recv = NGTCP2_MAX_UDP_PAYLOAD_SIZE;
+  ngtcp2_conn_del(conn);
+}
 
-  init_initial_crypto_ctx(&crypto_ctx);
+void test_ngtcp2_conn_recv_retire_connection_id(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_ssize spktlen;
+  ngtcp2_tstamp t = 1000000009;
+  int64_t pkt_num = 0;
+  ngtcp2_frame fr;
+  int rv;
+  ngtcp2_ksl_it it;
+  ngtcp2_scid *scid;
+  uint64_t seq;
 
-  ngtcp2_conn_set_initial_crypto_ctx(conn, &crypto_ctx);
-  ngtcp2_conn_install_initial_key(conn, &aead_ctx, null_iv, &hp_ctx, &aead_ctx,
-                                  null_iv, &hp_ctx, sizeof(null_iv));
+  setup_default_client(&conn);
+  conn->remote.transport_params->active_connection_id_limit = 7;
 
-  init_crypto_ctx(&crypto_ctx);
+  /* This will send NEW_CONNECTION_ID frames */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), t);
 
-  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
-  conn->negotiated_version = conn->client_chosen_version;
-  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
-                                       sizeof(null_iv), &hp_ctx);
-  ngtcp2_conn_install_tx_key(conn, null_secret, sizeof(null_secret), &aead_ctx,
-                             null_iv, sizeof(null_iv), &hp_ctx);
+  CU_ASSERT(spktlen > 0);
 
-  ngtcp2_connection_close_error_set_application_error(&ccerr, app_err_code,
-                                                      NULL, 0);
+  it = ngtcp2_ksl_begin(&conn->scid.set);
+  scid = ngtcp2_ksl_it_get(&it);
+  seq = scid->seq;
 
-  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
-                                               sizeof(buf), &ccerr, 0);
+  CU_ASSERT(NGTCP2_SCID_FLAG_NONE == scid->flags);
+  CU_ASSERT(UINT64_MAX == scid->retired_ts);
+  CU_ASSERT(1 == ngtcp2_pq_size(&conn->scid.used));
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+  fr.type = NGTCP2_FRAME_RETIRE_CONNECTION_ID;
+  fr.retire_connection_id.seq = seq;
 
-  p = buf;
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  shdlen = ngtcp2_pkt_decode_hd_long(&hd, p, (size_t)spktlen);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_INITIAL == hd.type);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_SCID_FLAG_RETIRED == scid->flags);
+  CU_ASSERT(1000000010 == scid->retired_ts);
+  CU_ASSERT(2 == ngtcp2_pq_size(&conn->scid.used));
+  CU_ASSERT(7 == ngtcp2_ksl_len(&conn->scid.set));
+  CU_ASSERT(1 == conn->scid.num_retired);
 
-  p += shdlen + (ngtcp2_ssize)hd.len;
-  spktlen -= shdlen + (ngtcp2_ssize)hd.len;
+  /* One NEW_CONNECTION_ID frame is sent as a replacement. */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  shdlen = ngtcp2_pkt_decode_hd_long(&hd, p, (size_t)spktlen);
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(8 == ngtcp2_ksl_len(&conn->scid.set));
+  CU_ASSERT(1 == conn->scid.num_retired);
 
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_HANDSHAKE == hd.type);
+  /* No NEW_CONNECTION_ID frames should be sent. */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  p += shdlen + (ngtcp2_ssize)hd.len;
-  spktlen -= shdlen + (ngtcp2_ssize)hd.len;
+  CU_ASSERT(spktlen == 0);
+  CU_ASSERT(8 == ngtcp2_ksl_len(&conn->scid.set));
+  CU_ASSERT(1 == conn->scid.num_retired);
 
-  shdlen = ngtcp2_pkt_decode_hd_short(&hd, p, (size_t)spktlen,
-                                      conn->dcid.current.cid.datalen);
+  /* Now time passed and retired connection ID is removed */
+  t += 7 * NGTCP2_DEFAULT_INITIAL_RTT;
 
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_1RTT == hd.type);
+  ngtcp2_conn_handle_expiry(conn, t);
+
+  CU_ASSERT(7 == ngtcp2_ksl_len(&conn->scid.set));
+  CU_ASSERT(0 == conn->scid.num_retired);
 
   ngtcp2_conn_del(conn);
 
-  /* Server has confirmed handshake */
+  /* Receiving RETIRE_CONNECTION_ID with seq which is greater than the
+     sequence number previously sent must be treated as error */
   setup_default_server(&conn);
 
-  ngtcp2_connection_close_error_set_application_error(&ccerr, app_err_code,
-                                                      NULL, 0);
-
-  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
-                                               sizeof(buf), &ccerr, 0);
+  fr.type = NGTCP2_FRAME_RETIRE_CONNECTION_ID;
+  fr.retire_connection_id.seq = 1;
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  shdlen = ngtcp2_pkt_decode_hd_short(&hd, buf, (size_t)spktlen,
-                                      conn->dcid.current.cid.datalen);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(shdlen > 0);
-  CU_ASSERT(NGTCP2_PKT_1RTT == hd.type);
+  CU_ASSERT(NGTCP2_ERR_PROTO == rv);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_rtb_reclaim_on_pto(void) {
+void test_ngtcp2_conn_get_new_connection_ids(void) {
   ngtcp2_conn *conn;
-  int rv;
-  int64_t stream_id;
   uint8_t buf[2048];
-  ngtcp2_ssize nwrite;
+  size_t pktlen;
   ngtcp2_ssize spktlen;
-  size_t i;
-  size_t num_reclaim_pkt;
-  ngtcp2_rtb_entry *ent;
-  ngtcp2_ksl_it it;
-
+  ngtcp2_tstamp t = 0;
+  int64_t pkt_num = 0;
+  ngtcp2_frame fr;
+  int rv;
+  ngtcp2_ksl_it it;
+  ngtcp2_scid *scid;
+  my_user_data ud;
+
   setup_default_client(&conn);
+  memset(&ud, 0, sizeof(ud));
+  conn->user_data = &ud;
+  conn->callbacks.get_new_connection_id = NULL;
+  conn->callbacks.get_new_connection_ids = get_new_connection_ids;
+  conn->remote.transport_params->active_connection_id_limit = 7;
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  /* All Connection IDs are requested in one call. */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), t);
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(1 == ud.get_new_connection_ids.ncalls);
+  CU_ASSERT(6 == ud.get_new_connection_ids.n);
+  CU_ASSERT(7 == ngtcp2_ksl_len(&conn->scid.set));
+  CU_ASSERT(6 == conn->scid.last_seq);
 
-  for (i = 0; i < 5; ++i) {
-    spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
-                                       &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
-                                       stream_id, null_data, 1024, 1);
+  it = ngtcp2_ksl_begin(&conn->scid.set);
+  for (; !ngtcp2_ksl_it_end(&it); ngtcp2_ksl_it_next(&it)) {
+    scid = ngtcp2_ksl_it_get(&it);
+    if (scid->seq == 0) {
+      continue;
+    }
 
-    CU_ASSERT(0 < spktlen);
+    CU_ASSERT(scid->seq == scid->cid.data[0]);
   }
 
-  CU_ASSERT(5 == ngtcp2_ksl_len(&conn->pktns.rtb.ents));
+  fr.type = NGTCP2_FRAME_RETIRE_CONNECTION_ID;
+  fr.retire_connection_id.seq = 1;
 
-  rv = ngtcp2_conn_on_loss_detection_timer(conn, 3 * NGTCP2_SECONDS);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf),
-                                  3 * NGTCP2_SECONDS);
+  /* A replacement is requested with n = 1. */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
   CU_ASSERT(spktlen > 0);
+  CU_ASSERT(2 == ud.get_new_connection_ids.ncalls);
+  CU_ASSERT(1 == ud.get_new_connection_ids.n);
+  CU_ASSERT(8 == ngtcp2_ksl_len(&conn->scid.set));
 
-  it = ngtcp2_ksl_begin(&conn->pktns.rtb.ents);
-  num_reclaim_pkt = 0;
-  for (; !ngtcp2_ksl_it_end(&it); ngtcp2_ksl_it_next(&it)) {
-    ent = ngtcp2_ksl_it_get(&it);
-    if (ent->flags & NGTCP2_RTB_ENTRY_FLAG_PTO_RECLAIMED) {
-      ++num_reclaim_pkt;
-    }
-  }
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(1 == num_reclaim_pkt);
+  /* Callback failure */
+  setup_default_client(&conn);
+  conn->callbacks.get_new_connection_id = NULL;
+  conn->callbacks.get_new_connection_ids = fail_get_new_connection_ids;
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), t);
+
+  CU_ASSERT(NGTCP2_ERR_CALLBACK_FAILURE == spktlen);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_rtb_reclaim_on_pto_datagram(void) {
+void test_ngtcp2_conn_server_path_validation(void) {
   ngtcp2_conn *conn;
-  int rv;
-  int64_t stream_id;
   uint8_t buf[2048];
-  ngtcp2_ssize nwrite;
+  size_t pktlen;
   ngtcp2_ssize spktlen;
-  size_t num_reclaim_pkt;
-  ngtcp2_rtb_entry *ent;
+  ngtcp2_tstamp t = 900;
+  int64_t pkt_num = 0;
+  ngtcp2_frame fr;
+  int rv;
+  const uint8_t raw_cid[] = {0x0f, 0x00, 0x00, 0x00};
+  ngtcp2_cid cid, *new_cid;
+  const uint8_t token[NGTCP2_STATELESS_RESET_TOKENLEN] = {0xff};
+  ngtcp2_path_storage new_path1, new_path2;
   ngtcp2_ksl_it it;
-  ngtcp2_vec datav;
-  int accepted;
-  ngtcp2_frame_chain *frc;
 
-  /* DATAGRAM frame must not be reclaimed on PTO */
-  setup_default_client(&conn);
+  path_init(&new_path1, 0, 0, 2, 0);
+  path_init(&new_path2, 0, 0, 3, 0);
 
-  conn->callbacks.ack_datagram = ack_datagram;
-  conn->remote.transport_params->max_datagram_frame_size = 65535;
+  ngtcp2_cid_init(&cid, raw_cid, sizeof(raw_cid));
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  setup_default_server(&conn);
 
-  CU_ASSERT(0 == rv);
+  /* This will send NEW_CONNECTION_ID frames */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
-                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
-                                     stream_id, null_data, 1024, 1);
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(ngtcp2_ksl_len(&conn->scid.set) > 1);
 
-  CU_ASSERT(0 < spktlen);
+  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  fr.new_connection_id.seq = 1;
+  fr.new_connection_id.retire_prior_to = 0;
+  fr.new_connection_id.cid = cid;
+  memcpy(fr.new_connection_id.stateless_reset_token, token, sizeof(token));
 
-  datav.base = null_data;
-  datav.len = 10;
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  spktlen = ngtcp2_conn_writev_datagram(
-      conn, NULL, NULL, buf, sizeof(buf), &accepted,
-      NGTCP2_WRITE_DATAGRAM_FLAG_NONE, 1000000007, &datav, 1, 1);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(accepted);
-  CU_ASSERT(0 < spktlen);
-  CU_ASSERT(2 == ngtcp2_ksl_len(&conn->pktns.rtb.ents));
+  CU_ASSERT(0 == rv);
 
-  rv = ngtcp2_conn_on_loss_detection_timer(conn, 3 * NGTCP2_SECONDS);
+  fr.type = NGTCP2_FRAME_PING;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &new_path1.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != conn->pv);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf),
-                                  3 * NGTCP2_SECONDS);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
   CU_ASSERT(spktlen > 0);
+  CU_ASSERT(ngtcp2_ringbuf_len(&conn->pv->ents.rb) > 0);
 
-  it = ngtcp2_ksl_begin(&conn->pktns.rtb.ents);
-  num_reclaim_pkt = 0;
-  for (; !ngtcp2_ksl_it_end(&it); ngtcp2_ksl_it_next(&it)) {
-    ent = ngtcp2_ksl_it_get(&it);
-    if (ent->flags & NGTCP2_RTB_ENTRY_FLAG_PTO_RECLAIMED) {
-      ++num_reclaim_pkt;
-      for (frc = ent->frc; frc; frc = frc->next) {
-        CU_ASSERT(NGTCP2_FRAME_DATAGRAM != frc->fr.type);
-      }
-    }
-  }
+  fr.type = NGTCP2_FRAME_PATH_RESPONSE;
+  memset(fr.path_response.data, 0, sizeof(fr.path_response.data));
 
-  CU_ASSERT(1 == num_reclaim_pkt);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  ngtcp2_conn_del(conn);
-}
+  rv = ngtcp2_conn_read_pkt(conn, &new_path1.path, &null_pi, buf, pktlen, ++t);
 
-void test_ngtcp2_conn_validate_ecn(void) {
-  ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  ngtcp2_ssize spktlen;
-  ngtcp2_pkt_info pi;
-  size_t pktlen;
-  int rv;
-  ngtcp2_frame fr;
-  int64_t stream_id;
-  ngtcp2_ssize nwrite;
-  size_t i;
-  ngtcp2_tstamp t = 0;
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(ngtcp2_path_eq(&new_path1.path, &conn->dcid.current.ps.path));
+  /* DCID does not change because the client does not change its
+     DCID. */
+  CU_ASSERT(!ngtcp2_cid_eq(&cid, &conn->dcid.current.cid));
 
-  setup_default_client(&conn);
+  /* A remote endpoint changes DCID as well */
+  fr.type = NGTCP2_FRAME_PING;
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, &pi, buf, sizeof(buf), 1);
+  it = ngtcp2_ksl_begin(&conn->scid.set);
 
-  CU_ASSERT(0 < spktlen);
-  CU_ASSERT(NGTCP2_ECN_ECT_0 == pi.ecn);
-  CU_ASSERT(NGTCP2_ECN_STATE_TESTING == conn->tx.ecn.state);
-  CU_ASSERT(1 == conn->tx.ecn.validation_start_ts);
-  CU_ASSERT(0 == conn->pktns.tx.ecn.start_pkt_num);
+  assert(!ngtcp2_ksl_it_end(&it));
 
-  fr.type = NGTCP2_FRAME_ACK_ECN;
-  fr.ack.largest_ack = 0;
-  fr.ack.ack_delay = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
-  fr.ack.ecn.ect0 = 1;
-  fr.ack.ecn.ect1 = 0;
-  fr.ack.ecn.ce = 0;
+  new_cid = &(((ngtcp2_scid *)ngtcp2_ksl_it_get(&it))->cid);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), new_cid, ++pkt_num, &fr,
                                   conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
-
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NGTCP2_ECN_STATE_CAPABLE == conn->tx.ecn.state);
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  rv = ngtcp2_conn_read_pkt(conn, &new_path2.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != conn->pv);
 
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf), &nwrite,
-                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                     null_data, 1024, 2);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  CU_ASSERT(0 < spktlen);
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(ngtcp2_ringbuf_len(&conn->pv->ents.rb) > 0);
 
-  /* Receiving ACK frame containing less ECN counts fails
-     validation */
-  fr.type = NGTCP2_FRAME_ACK_ECN;
-  fr.ack.largest_ack = 1;
-  fr.ack.ack_delay = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
-  fr.ack.ecn.ect0 = 0;
-  fr.ack.ecn.ect1 = 0;
-  fr.ack.ecn.ce = 0;
+  fr.type = NGTCP2_FRAME_PATH_RESPONSE;
+  memset(fr.path_response.data, 0, sizeof(fr.path_response.data));
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), new_cid, ++pkt_num, &fr,
                                   conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 3);
+
+  rv = ngtcp2_conn_read_pkt(conn, &new_path2.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NGTCP2_ECN_STATE_FAILED == conn->tx.ecn.state);
+  CU_ASSERT(ngtcp2_path_eq(&new_path2.path, &conn->dcid.current.ps.path));
+  CU_ASSERT(ngtcp2_cid_eq(&cid, &conn->dcid.current.cid));
 
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf), &nwrite,
-                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                     null_data, 1024, 2);
+  ngtcp2_conn_del(conn);
+}
 
-  CU_ASSERT(0 < spktlen);
-  CU_ASSERT(NGTCP2_ECN_NOT_ECT == pi.ecn);
+void test_ngtcp2_conn_get_path_stat(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_ssize spktlen;
+  ngtcp2_tstamp t = 900;
+  int64_t pkt_num = 0;
+  ngtcp2_frame fr;
+  int rv;
+  ngtcp2_path_storage new_path;
+  ngtcp2_path_stat pstat;
 
-  ngtcp2_conn_del(conn);
+  path_init(&new_path, 0, 0, 2, 0);
 
-  /* Receiving ACK frame without ECN counts invalidates ECN
-     capability */
   setup_default_server(&conn);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, &pi, buf, sizeof(buf), 1);
+  conn->cstat.latest_rtt = 30 * NGTCP2_MILLISECONDS;
+  conn->cstat.min_rtt = 30 * NGTCP2_MILLISECONDS;
+  conn->cstat.smoothed_rtt = 30 * NGTCP2_MILLISECONDS;
+  conn->dcid.current.lost_pkt_count = 2;
 
-  CU_ASSERT(0 < spktlen);
-  CU_ASSERT(NGTCP2_ECN_ECT_0 == pi.ecn);
-  CU_ASSERT(NGTCP2_ECN_STATE_TESTING == conn->tx.ecn.state);
-  CU_ASSERT(1 == conn->tx.ecn.validation_start_ts);
-  CU_ASSERT(0 == conn->pktns.tx.ecn.start_pkt_num);
+  rv = ngtcp2_conn_get_path_stat(conn, NGTCP2_PATH_ROLE_ACTIVE, &pstat);
 
-  fr.type = NGTCP2_FRAME_ACK;
-  fr.ack.largest_ack = 0;
-  fr.ack.ack_delay = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(ngtcp2_path_eq(&null_path.path, &pstat.path));
+  CU_ASSERT(30 * NGTCP2_MILLISECONDS == pstat.smoothed_rtt);
+  CU_ASSERT(2 == pstat.lost_pkt_count);
+  CU_ASSERT(UINT64_MAX == pstat.validation_start_ts);
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT ==
+            ngtcp2_conn_get_path_stat(conn, NGTCP2_PATH_ROLE_FALLBACK, &pstat));
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT ==
+            ngtcp2_conn_get_path_stat(conn, NGTCP2_PATH_ROLE_PROBING, &pstat));
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
+  /* The remote endpoint migrates to new_path. */
+  fr.type = NGTCP2_FRAME_PING;
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NGTCP2_ECN_STATE_FAILED == conn->tx.ecn.state);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  ngtcp2_conn_del(conn);
+  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
 
-  /* CE counts must be considered */
-  setup_default_client(&conn);
+  CU_ASSERT(0 == rv);
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  rv = ngtcp2_conn_get_path_stat(conn, NGTCP2_PATH_ROLE_FALLBACK, &pstat);
 
   CU_ASSERT(0 == rv);
+  CU_ASSERT(ngtcp2_path_eq(&null_path.path, &pstat.path));
+  CU_ASSERT(30 * NGTCP2_MILLISECONDS == pstat.smoothed_rtt);
+  CU_ASSERT(2 == pstat.lost_pkt_count);
 
-  for (i = 0; i < 2; ++i) {
-    spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf),
-                                       &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
-                                       stream_id, null_data, 1024, 2);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-    CU_ASSERT(0 < spktlen);
-    CU_ASSERT(NGTCP2_ECN_ECT_0 == pi.ecn);
-  }
+  CU_ASSERT(spktlen > 0);
 
-  CU_ASSERT(NGTCP2_ECN_STATE_TESTING == conn->tx.ecn.state);
-  CU_ASSERT(2 == conn->tx.ecn.validation_start_ts);
-  CU_ASSERT(0 == conn->pktns.tx.ecn.start_pkt_num);
+  rv = ngtcp2_conn_get_path_stat(conn, NGTCP2_PATH_ROLE_PROBING, &pstat);
 
-  fr.type = NGTCP2_FRAME_ACK_ECN;
-  fr.ack.largest_ack = 1;
-  fr.ack.ack_delay = 0;
-  fr.ack.first_ack_blklen = 1;
-  fr.ack.num_blks = 0;
-  fr.ack.ecn.ect0 = 1;
-  fr.ack.ecn.ect1 = 0;
-  fr.ack.ecn.ce = 1;
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(ngtcp2_path_eq(&new_path.path, &pstat.path));
+  CU_ASSERT(t == pstat.validation_start_ts);
+  CU_ASSERT(UINT64_MAX == pstat.validated_ts);
+  CU_ASSERT(0 == pstat.lost_pkt_count);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
+  fr.type = NGTCP2_FRAME_PATH_RESPONSE;
+  memset(fr.path_response.data, 0, sizeof(fr.path_response.data));
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+
+  t += 10 * NGTCP2_MILLISECONDS;
+
+  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NGTCP2_ECN_STATE_CAPABLE == conn->tx.ecn.state);
-  CU_ASSERT(0 == ngtcp2_ksl_len(&conn->pktns.rtb.ents));
+
+  rv = ngtcp2_conn_get_path_stat(conn, NGTCP2_PATH_ROLE_ACTIVE, &pstat);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(ngtcp2_path_eq(&new_path.path, &pstat.path));
+  CU_ASSERT(pstat.validated);
+  CU_ASSERT(t == pstat.validated_ts);
+  CU_ASSERT(pstat.bytes_sent > 0);
+  CU_ASSERT(pstat.bytes_recv > 0);
+  CU_ASSERT(UINT64_MAX == conn->cstat.min_rtt);
+  CU_ASSERT(10 * NGTCP2_MILLISECONDS == pstat.smoothed_rtt);
 
   ngtcp2_conn_del(conn);
+}
 
-  /* If increments of ECN counts is less than the number of
-     acknowledged ECN entries, ECN validation fails. */
+void test_ngtcp2_conn_client_connection_migration(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_tstamp t = 900;
+  int64_t pkt_num = 0;
+  ngtcp2_frame fr;
+  int rv;
+  const uint8_t raw_cid[] = {0x0f, 0x00, 0x00, 0x00};
+  ngtcp2_cid cid;
+  const uint8_t token[NGTCP2_STATELESS_RESET_TOKENLEN] = {0xff};
+  my_user_data ud;
+  ngtcp2_ssize spktlen;
+  ngtcp2_path_storage to_path;
+
+  ngtcp2_cid_init(&cid, raw_cid, sizeof(raw_cid));
+
+  /* immediate migration */
   setup_default_client(&conn);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, &pi, buf, sizeof(buf), 1);
+  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  fr.new_connection_id.seq = 1;
+  fr.new_connection_id.retire_prior_to = 0;
+  fr.new_connection_id.cid = cid;
+  memcpy(fr.new_connection_id.stateless_reset_token, token, sizeof(token));
 
-  CU_ASSERT(0 < spktlen);
-  CU_ASSERT(NGTCP2_ECN_ECT_0 == pi.ecn);
-  CU_ASSERT(NGTCP2_ECN_STATE_TESTING == conn->tx.ecn.state);
-  CU_ASSERT(1 == conn->tx.ecn.validation_start_ts);
-  CU_ASSERT(0 == conn->pktns.tx.ecn.start_pkt_num);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  fr.type = NGTCP2_FRAME_ACK_ECN;
-  fr.ack.largest_ack = 0;
-  fr.ack.ack_delay = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
-  fr.ack.ecn.ect0 = 0;
-  fr.ack.ecn.ect1 = 1;
-  fr.ack.ecn.ce = 0;
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_path_storage_init2(&to_path, &new_path.path);
+  to_path.path.user_data = &ud;
+
+  rv = ngtcp2_conn_initiate_immediate_migration(conn, &to_path.path, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NGTCP2_ECN_STATE_FAILED == conn->tx.ecn.state);
+  CU_ASSERT(NULL == conn->pv);
+  CU_ASSERT(ngtcp2_path_eq(&to_path.path, &conn->dcid.current.ps.path));
+  CU_ASSERT(&ud == conn->dcid.current.ps.path.user_data);
+  CU_ASSERT(ngtcp2_cid_eq(&cid, &conn->dcid.current.cid));
 
   ngtcp2_conn_del(conn);
 
-  /* If ECT count is larger than the number of ECT marked packet, ECN
-     validation fails. */
+  /* migrate after successful path validation */
   setup_default_client(&conn);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, &pi, buf, sizeof(buf), 1);
+  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  fr.new_connection_id.seq = 1;
+  fr.new_connection_id.retire_prior_to = 0;
+  fr.new_connection_id.cid = cid;
+  memcpy(fr.new_connection_id.stateless_reset_token, token, sizeof(token));
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_path_storage_init2(&to_path, &new_path.path);
+  to_path.path.user_data = &ud;
+
+  rv = ngtcp2_conn_initiate_migration(conn, &to_path.path, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != conn->pv);
+  CU_ASSERT(ngtcp2_path_eq(&null_path.path, &conn->dcid.current.ps.path));
+  CU_ASSERT(NULL == conn->dcid.current.ps.path.user_data);
+  CU_ASSERT(ngtcp2_cid_eq(&conn->rcid, &conn->dcid.current.cid));
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
   CU_ASSERT(0 < spktlen);
-  CU_ASSERT(NGTCP2_ECN_ECT_0 == pi.ecn);
-  CU_ASSERT(NGTCP2_ECN_STATE_TESTING == conn->tx.ecn.state);
-  CU_ASSERT(1 == conn->tx.ecn.validation_start_ts);
-  CU_ASSERT(0 == conn->pktns.tx.ecn.start_pkt_num);
 
-  fr.type = NGTCP2_FRAME_ACK_ECN;
-  fr.ack.largest_ack = 0;
-  fr.ack.ack_delay = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
-  fr.ack.ecn.ect0 = 2;
-  fr.ack.ecn.ect1 = 0;
-  fr.ack.ecn.ce = 0;
+  fr.type = NGTCP2_FRAME_PATH_RESPONSE;
+  memset(fr.path_response.data, 0, sizeof(fr.path_response.data));
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NGTCP2_ECN_STATE_FAILED == conn->tx.ecn.state);
+  CU_ASSERT(NULL == conn->pv);
+  CU_ASSERT(ngtcp2_path_eq(&to_path.path, &conn->dcid.current.ps.path));
+  CU_ASSERT(&ud == conn->dcid.current.ps.path.user_data);
+  CU_ASSERT(ngtcp2_cid_eq(&cid, &conn->dcid.current.cid));
 
   ngtcp2_conn_del(conn);
+}
 
-  /* ECN validation fails if all ECN marked packets are lost */
-  setup_default_client(&conn);
+void test_ngtcp2_conn_recv_path_challenge(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_ssize spktlen;
+  ngtcp2_tstamp t = 11;
+  int64_t pkt_num = 0;
+  ngtcp2_frame fr;
+  ngtcp2_frame frs[2];
+  int rv;
+  const uint8_t raw_cid[] = {0x0f, 0x00, 0x00, 0x00};
+  ngtcp2_cid cid;
+  const uint8_t token[NGTCP2_STATELESS_RESET_TOKENLEN] = {0xff};
+  const uint8_t data[] = {0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8};
+  const uint8_t data2[] = {0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf9};
+  ngtcp2_path_storage ps;
+  ngtcp2_ssize shdlen;
+  ngtcp2_pkt_hd hd;
 
-  t = 0;
+  ngtcp2_cid_init(&cid, raw_cid, sizeof(raw_cid));
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  setup_default_server(&conn);
+
+  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  fr.new_connection_id.seq = 1;
+  fr.new_connection_id.retire_prior_to = 0;
+  fr.new_connection_id.cid = cid;
+  memcpy(fr.new_connection_id.stateless_reset_token, token, sizeof(token));
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
 
-  for (i = 0; i < NGTCP2_ECN_MAX_NUM_VALIDATION_PKTS; ++i) {
-    spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf),
-                                       &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
-                                       stream_id, null_data, 25, t);
+  frs[0].type = NGTCP2_FRAME_PATH_CHALLENGE;
+  memcpy(frs[0].path_challenge.data, data, sizeof(frs[0].path_challenge.data));
+  frs[1].type = NGTCP2_FRAME_PADDING;
+  frs[1].padding.len = 1200;
 
-    CU_ASSERT(0 < spktlen);
-    CU_ASSERT(NGTCP2_ECN_ECT_0 == pi.ecn);
-  }
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 2,
+                     conn->pktns.crypto.rx.ckm);
 
-  CU_ASSERT(NGTCP2_ECN_STATE_UNKNOWN == conn->tx.ecn.state);
-  CU_ASSERT(NGTCP2_ECN_MAX_NUM_VALIDATION_PKTS == conn->tx.ecn.dgram_sent);
+  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
 
-  t += NGTCP2_MILLISECONDS;
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(ngtcp2_ringbuf_len(&conn->rx.path_challenge.rb) > 0);
 
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf), &nwrite,
-                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                     null_data, 25, t);
+  ngtcp2_path_storage_zero(&ps);
 
-  CU_ASSERT(0 < spktlen);
-  CU_ASSERT(NGTCP2_ECN_NOT_ECT == pi.ecn);
-  CU_ASSERT(NGTCP2_ECN_STATE_UNKNOWN == conn->tx.ecn.state);
-  CU_ASSERT(0 == conn->tx.ecn.validation_start_ts);
-  CU_ASSERT(0 == conn->pktns.tx.ecn.start_pkt_num);
-  CU_ASSERT(NGTCP2_ECN_MAX_NUM_VALIDATION_PKTS == conn->tx.ecn.dgram_sent);
-  CU_ASSERT(0 == conn->pktns.tx.ecn.validation_pkt_lost);
+  spktlen = ngtcp2_conn_write_pkt(conn, &ps.path, NULL, buf, sizeof(buf), ++t);
 
-  fr.type = NGTCP2_FRAME_ACK;
-  fr.ack.largest_ack = NGTCP2_ECN_MAX_NUM_VALIDATION_PKTS;
-  fr.ack.ack_delay = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
+  CU_ASSERT(spktlen >= 1200);
+  CU_ASSERT(ngtcp2_path_eq(&new_path.path, &ps.path));
+  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->rx.path_challenge.rb));
+  CU_ASSERT(1 == ngtcp2_ringbuf_len(&conn->dcid.bound.rb));
 
-  t += NGTCP2_MILLISECONDS;
+  shdlen = ngtcp2_pkt_decode_hd_short(&hd, buf, (size_t)spktlen, cid.datalen);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, t);
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(ngtcp2_cid_eq(&cid, &hd.dcid));
+
+  /* Use same bound DCID for PATH_CHALLENGE from the same path. */
+  fr.type = NGTCP2_FRAME_PATH_CHALLENGE;
+  memcpy(fr.path_challenge.data, data2, sizeof(fr.path_challenge.data));
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(ngtcp2_ringbuf_len(&conn->rx.path_challenge.rb) > 0);
+
+  ngtcp2_path_storage_zero(&ps);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, &ps.path, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(ngtcp2_path_eq(&new_path.path, &ps.path));
+  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->rx.path_challenge.rb));
+  CU_ASSERT(1 == ngtcp2_ringbuf_len(&conn->dcid.bound.rb));
+
+  shdlen = ngtcp2_pkt_decode_hd_short(&hd, buf, (size_t)spktlen, cid.datalen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(ngtcp2_cid_eq(&cid, &hd.dcid));
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_key_update(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_ssize spktlen;
+  ngtcp2_tstamp t = 19393;
+  int64_t pkt_num = -1;
+  ngtcp2_frame fr;
+  int rv;
+  int64_t stream_id;
+  ngtcp2_ssize nwrite;
+
+  setup_default_server(&conn);
+
+  /* The remote endpoint initiates key update */
+  fr.type = NGTCP2_FRAME_PING;
+
+  pktlen = write_single_frame_pkt_flags(
+      buf, sizeof(buf), NGTCP2_PKT_FLAG_KEY_PHASE, &conn->oscid, ++pkt_num, &fr,
+      conn->pktns.crypto.rx.ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != conn->crypto.key_update.old_rx_ckm);
+  CU_ASSERT(NULL == conn->crypto.key_update.new_tx_ckm);
+  CU_ASSERT(NULL == conn->crypto.key_update.new_rx_ckm);
+  CU_ASSERT(UINT64_MAX == conn->crypto.key_update.confirmed_ts);
+  CU_ASSERT(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_NOT_CONFIRMED);
+  CU_ASSERT(!(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_INITIATOR));
+
+  t += NGTCP2_SECONDS;
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(t == conn->crypto.key_update.confirmed_ts);
+  CU_ASSERT(!(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_NOT_CONFIRMED));
+  CU_ASSERT(!(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_INITIATOR));
+
+  t += ngtcp2_conn_get_pto(conn) + 1;
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), t);
+
+  CU_ASSERT(0 == spktlen);
+  CU_ASSERT(NULL == conn->crypto.key_update.old_rx_ckm);
+  CU_ASSERT(NULL != conn->crypto.key_update.new_tx_ckm);
+  CU_ASSERT(NULL != conn->crypto.key_update.new_rx_ckm);
+
+  /* The local endpoint initiates key update */
+  t += ngtcp2_conn_get_pto(conn) * 2;
+
+  rv = ngtcp2_conn_initiate_key_update(conn, t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != conn->crypto.key_update.old_rx_ckm);
+  CU_ASSERT(NULL == conn->crypto.key_update.new_tx_ckm);
+  CU_ASSERT(NULL == conn->crypto.key_update.new_rx_ckm);
+  CU_ASSERT(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_NOT_CONFIRMED);
+  CU_ASSERT(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_INITIATOR);
+
+  rv = ngtcp2_conn_open_uni_stream(conn, &stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, null_data, 1024, ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_NOT_CONFIRMED);
+
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+
+  pktlen = write_single_frame_pkt_flags(
+      buf, sizeof(buf), NGTCP2_PKT_FLAG_KEY_PHASE, &conn->oscid, ++pkt_num, &fr,
+      conn->pktns.crypto.rx.ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(t == conn->crypto.key_update.confirmed_ts);
+  CU_ASSERT(!(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_NOT_CONFIRMED));
+  CU_ASSERT(!(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_INITIATOR));
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_eager_key_update(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_ssize spktlen;
+  ngtcp2_tstamp t = 19393;
+  int64_t pkt_num = -1;
+  ngtcp2_frame fr;
+  int rv;
+  ngtcp2_crypto_km *rx_ckm;
+
+  setup_default_server(&conn);
+  conn->local.settings.eager_key_update = 1;
+
+  /* The remote endpoint initiates key update */
+  fr.type = NGTCP2_FRAME_PING;
+
+  pktlen = write_single_frame_pkt_flags(
+      buf, sizeof(buf), NGTCP2_PKT_FLAG_KEY_PHASE, &conn->oscid, ++pkt_num, &fr,
+      conn->pktns.crypto.rx.ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != conn->crypto.key_update.old_rx_ckm);
+  CU_ASSERT(NULL == conn->crypto.key_update.new_tx_ckm);
+  CU_ASSERT(NULL == conn->crypto.key_update.new_rx_ckm);
+
+  t += NGTCP2_SECONDS;
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(t == conn->crypto.key_update.confirmed_ts);
+
+  /* The next keys are derived without waiting for PTO, and the old
+     decryption key is kept. */
+  rv = ngtcp2_conn_prepare_key_update(conn, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != conn->crypto.key_update.old_rx_ckm);
+  CU_ASSERT(NULL != conn->crypto.key_update.new_tx_ckm);
+  CU_ASSERT(NULL != conn->crypto.key_update.new_rx_ckm);
+
+  /* The remote endpoint starts the next key phase before the old
+     decryption key is discarded. */
+  rx_ckm = conn->pktns.crypto.rx.ckm;
+
+  pktlen = write_single_frame_pkt_flags(
+      buf, sizeof(buf), NGTCP2_PKT_FLAG_NONE, &conn->oscid, ++pkt_num, &fr,
+      conn->crypto.key_update.new_rx_ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(rx_ckm == conn->crypto.key_update.old_rx_ckm);
+  CU_ASSERT(NULL == conn->crypto.key_update.new_tx_ckm);
+  CU_ASSERT(NULL == conn->crypto.key_update.new_rx_ckm);
+  CU_ASSERT(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_NOT_CONFIRMED);
+
+  /* The old decryption key is discarded 1 PTO after confirmation. */
+  t += NGTCP2_SECONDS;
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(t == conn->crypto.key_update.confirmed_ts);
+  CU_ASSERT(NULL != conn->crypto.key_update.old_rx_ckm);
+
+  t += ngtcp2_conn_get_pto(conn) + 1;
+  rv = ngtcp2_conn_prepare_key_update(conn, t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL == conn->crypto.key_update.old_rx_ckm);
+  CU_ASSERT(NULL != conn->crypto.key_update.new_tx_ckm);
+  CU_ASSERT(NULL != conn->crypto.key_update.new_rx_ckm);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_auto_key_update(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_tstamp t = 19393;
+  int rv;
+
+  setup_default_server(&conn);
+  conn->pktns.crypto.ctx.max_encryption = 65536;
+  conn->crypto.key_update.jitter = 255;
+
+  rv = ngtcp2_conn_prepare_key_update(conn, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != conn->crypto.key_update.new_tx_ckm);
+
+  /* The threshold is 65536 * 3 / 4 + (65536 >> 11) * 255 = 57312. */
+  conn->pktns.crypto.tx.ckm->use_count = 57311;
+
+  rv = ngtcp2_conn_prepare_key_update(conn, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(!(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_NOT_CONFIRMED));
+
+  conn->pktns.crypto.tx.ckm->use_count = 57312;
+
+  rv = ngtcp2_conn_prepare_key_update(conn, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == conn->pktns.crypto.tx.ckm->use_count);
+  CU_ASSERT(NULL == conn->crypto.key_update.new_tx_ckm);
+  CU_ASSERT(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_NOT_CONFIRMED);
+  CU_ASSERT(conn->flags & NGTCP2_CONN_FLAG_KEY_UPDATE_INITIATOR);
+
+  /* Key update cannot be initiated until the current one is
+     confirmed.  It is retried until the limit is reached. */
+  conn->pktns.crypto.tx.ckm->use_count = 65535;
+
+  rv = ngtcp2_conn_prepare_key_update(conn, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  conn->pktns.crypto.tx.ckm->use_count = 65536;
+
+  rv = ngtcp2_conn_prepare_key_update(conn, ++t);
+
+  CU_ASSERT(NGTCP2_ERR_AEAD_LIMIT_REACHED == rv);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_crypto_offload(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_settings settings;
+  uint8_t buf[1200];
+  ngtcp2_pkt_info pi;
+  ngtcp2_ssize spktlen, nwrite, nread;
+  ngtcp2_tstamp t = 0;
+  int64_t stream_id;
+  ngtcp2_frame fr;
+  const uint8_t *p, *end;
+  my_user_data ud;
+  int rv;
+
+  server_default_settings(&settings);
+  settings.crypto_offload = 1;
+
+  setup_default_server_settings(&conn, &settings);
+  conn->callbacks.offload_tx_key = offload_tx_key;
+  conn->user_data = &ud;
+  memset(&ud.offload_tx_key, 0, sizeof(ud.offload_tx_key));
+
+  rv = ngtcp2_conn_open_uni_stream(conn, &stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf),
+                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, null_data, 100, ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(100 == nwrite);
+  CU_ASSERT(spktlen == pi.offload_pktlen);
+  CU_ASSERT(0 == pi.offload_key_id);
+  CU_ASSERT(0 == pi.offload_pkt_num);
+  CU_ASSERT(1 + conn->dcid.current.cid.datalen + pi.offload_pkt_numlen ==
+            pi.offload_hdlen);
+
+  /* The payload is left in plaintext. */
+  p = buf + pi.offload_hdlen;
+  end = buf + spktlen - NGTCP2_FAKE_AEAD_OVERHEAD;
+
+  for (;;) {
+    fr.type = NGTCP2_FRAME_PADDING;
+    nread = ngtcp2_pkt_decode_frame(&fr, p, (size_t)(end - p));
+
+    CU_ASSERT(nread > 0);
+
+    if (nread <= 0 || fr.type == NGTCP2_FRAME_STREAM) {
+      break;
+    }
+
+    p += nread;
+  }
+
+  CU_ASSERT(NGTCP2_FRAME_STREAM == fr.type);
+  CU_ASSERT(stream_id == fr.stream.stream_id);
+
+  /* The key of the next key phase is installed before it is used. */
+  rv = ngtcp2_conn_prepare_key_update(conn, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == ud.offload_tx_key.ncalls);
+  CU_ASSERT(1 == ud.offload_tx_key.key_id);
+
+  rv = ngtcp2_conn_initiate_key_update(conn, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf),
+                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, null_data, 100, ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(spktlen == pi.offload_pktlen);
+  CU_ASSERT(1 == pi.offload_key_id);
+  CU_ASSERT(1 == pi.offload_pkt_num);
+
+  /* The packet which is not written along with the application data
+     is protected by the library. */
+  spktlen = ngtcp2_conn_write_keep_alive(conn, NULL, &pi, buf, sizeof(buf),
+                                         ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(0 == pi.offload_pktlen);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_crypto_buffer_exceeded(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_tstamp t = 11111;
+  int64_t pkt_num = -1;
+  ngtcp2_frame fr;
+  int rv;
+
+  setup_default_client(&conn);
+
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 1000000;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].base = null_data;
+  fr.crypto.data[0].len = 1;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(NGTCP2_ERR_CRYPTO_BUFFER_EXCEEDED == rv);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_handshake_probe(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_ssize spktlen;
+  size_t pktlen;
+  uint8_t buf[1200];
+  ngtcp2_frame fr;
+  ngtcp2_rtb_entry *ent;
+  ngtcp2_rtb_it it;
+  int rv;
+  ngtcp2_crypto_aead_ctx aead_ctx = {0};
+  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
+  ngtcp2_crypto_ctx crypto_ctx;
+
+  /* Retransmit first Initial on PTO timer */
+  setup_handshake_client(&conn);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(1 == conn->in_pktns->rtb.num_ack_eliciting);
+
+  rv = ngtcp2_conn_on_loss_detection_timer(conn, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == conn->in_pktns->rtb.probe_pkt_left);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(1 == conn->in_pktns->rtb.num_retransmittable);
+  CU_ASSERT(2 == conn->in_pktns->rtb.num_ack_eliciting);
+  CU_ASSERT(0 == conn->in_pktns->rtb.probe_pkt_left);
+
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = 0;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
+      ngtcp2_conn_get_dcid(conn), 0, NGTCP2_PROTO_VER_V1, &fr, &null_ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == conn->in_pktns->rtb.num_ack_eliciting);
+
+  rv = ngtcp2_conn_on_loss_detection_timer(conn, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == conn->in_pktns->rtb.num_retransmittable);
+  CU_ASSERT(1 == conn->in_pktns->rtb.num_ack_eliciting);
+  CU_ASSERT(1 == conn->in_pktns->rtb.probe_pkt_left);
+
+  /* This sends anti-deadlock padded Initial packet even if we have
+     nothing to send. */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(0 == conn->in_pktns->rtb.num_retransmittable);
+  CU_ASSERT(2 == conn->in_pktns->rtb.num_ack_eliciting);
+  CU_ASSERT(0 == conn->in_pktns->rtb.probe_pkt_left);
+
+  it = ngtcp2_rtb_head(&conn->in_pktns->rtb);
+  ent = ngtcp2_rtb_it_get(&it);
+
+  CU_ASSERT(ent->flags & NGTCP2_RTB_ENTRY_FLAG_PROBE);
+  CU_ASSERT(sizeof(buf) == ent->pktlen);
+
+  init_crypto_ctx(&crypto_ctx);
+  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
+  conn->negotiated_version = conn->client_chosen_version;
+  ngtcp2_conn_install_rx_handshake_key(conn, &aead_ctx, null_iv,
+                                       sizeof(null_iv), &hp_ctx);
+  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
+                                       sizeof(null_iv), &hp_ctx);
+
+  rv = ngtcp2_conn_on_loss_detection_timer(conn, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(2 == conn->in_pktns->rtb.num_ack_eliciting);
+  CU_ASSERT(1 == conn->hs_pktns->rtb.probe_pkt_left);
+
+  /* This sends anti-deadlock Handshake packet even if we have nothing
+     to send. */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(0 == conn->hs_pktns->rtb.num_retransmittable);
+  CU_ASSERT(1 == conn->hs_pktns->rtb.num_ack_eliciting);
+  CU_ASSERT(0 == conn->hs_pktns->rtb.probe_pkt_left);
+
+  it = ngtcp2_rtb_head(&conn->hs_pktns->rtb);
+  ent = ngtcp2_rtb_it_get(&it);
+
+  CU_ASSERT(ent->flags & NGTCP2_RTB_ENTRY_FLAG_PROBE);
+  CU_ASSERT(sizeof(buf) > ent->pktlen);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_handshake_loss(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_ssize spktlen;
+  size_t i;
+  size_t pktlen;
+  uint8_t buf[1252];
+  ngtcp2_frame fr;
+  ngtcp2_frame frs[2];
+  ngtcp2_cid rcid;
+  int rv;
+  int64_t pkt_num = -1;
+  ngtcp2_rtb_it it;
+  ngtcp2_rtb_entry *ent;
+
+  rcid_init(&rcid);
+  setup_handshake_server(&conn);
+  conn->callbacks.recv_crypto_data = recv_crypto_data;
+
+  frs[0].type = NGTCP2_FRAME_CRYPTO;
+  frs[0].crypto.offset = 0;
+  frs[0].crypto.datacnt = 1;
+  frs[0].crypto.data[0].len = 123;
+  frs[0].crypto.data[0].base = null_data;
+
+  frs[1].type = NGTCP2_FRAME_PADDING;
+  frs[1].padding.len = 1005;
+
+  pktlen = write_handshake_pkt(buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid,
+                               ngtcp2_conn_get_dcid(conn), ++pkt_num,
+                               conn->client_chosen_version, frs, 2, &null_ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  /* Increase anti-amplification factor for easier testing */
+  conn->dcid.current.bytes_recv += 10000;
+
+  ngtcp2_conn_submit_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_INITIAL, null_data,
+                                 123);
+  ngtcp2_conn_submit_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_HANDSHAKE, null_data,
+                                 163);
+  ngtcp2_conn_submit_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_HANDSHAKE, null_data,
+                                 2369);
+  ngtcp2_conn_submit_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_HANDSHAKE, null_data,
+                                 79);
+  ngtcp2_conn_submit_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_HANDSHAKE, null_data,
+                                 36);
+
+  /* Initial and first Handshake are coalesced into 1 packet. */
+  for (i = 0; i < 3; ++i) {
+    spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+    CU_ASSERT(spktlen > 0);
+  }
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(0 == spktlen);
+
+  t += 1000;
+
+  ngtcp2_conn_on_loss_detection_timer(conn, t);
+
+  CU_ASSERT(1 == conn->in_pktns->rtb.probe_pkt_left);
+  CU_ASSERT(1 == conn->hs_pktns->rtb.probe_pkt_left);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(0 == spktlen);
+
+  it = ngtcp2_rtb_head(&conn->hs_pktns->rtb);
+  ent = ngtcp2_rtb_it_get(&it);
+
+  CU_ASSERT(0 == ent->frc->fr.crypto.offset);
+  CU_ASSERT(987 == ngtcp2_vec_len(ent->frc->fr.crypto.data,
+                                  ent->frc->fr.crypto.datacnt));
+  CU_ASSERT(3 == ent->hd.pkt_num);
+
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = 2;
+  fr.ack.ack_delay = 0;
+  fr.ack.ack_delay_unscaled = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_HANDSHAKE, &conn->oscid,
+      ngtcp2_conn_get_dcid(conn), ++pkt_num, conn->client_chosen_version, &fr,
+      &null_ckm);
+
+  t += 8;
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, t);
+
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_conn_on_loss_detection_timer(conn, t);
+
+  /* Retransmits the contents of lost packet */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  it = ngtcp2_rtb_head(&conn->hs_pktns->rtb);
+  ent = ngtcp2_rtb_it_get(&it);
+
+  CU_ASSERT(NGTCP2_FRAME_CRYPTO == ent->frc->fr.type);
+  CU_ASSERT(987 == ent->frc->fr.crypto.offset);
+  CU_ASSERT(1 == ent->frc->fr.crypto.datacnt);
+  CU_ASSERT(1183 == ngtcp2_vec_len(ent->frc->fr.crypto.data,
+                                   ent->frc->fr.crypto.datacnt));
+  CU_ASSERT(4 == ent->hd.pkt_num);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(0 == spktlen);
+
+  t += 1000;
+
+  ngtcp2_conn_on_loss_detection_timer(conn, t);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  it = ngtcp2_rtb_head(&conn->hs_pktns->rtb);
+  ent = ngtcp2_rtb_it_get(&it);
+
+  CU_ASSERT(NGTCP2_FRAME_CRYPTO == ent->frc->fr.type);
+  CU_ASSERT(0 == ent->frc->fr.crypto.offset);
+  CU_ASSERT(2 == ent->frc->fr.crypto.datacnt);
+  CU_ASSERT(987 == ngtcp2_vec_len(ent->frc->fr.crypto.data,
+                                  ent->frc->fr.crypto.datacnt));
+  CU_ASSERT(5 == ent->hd.pkt_num);
+
+  ngtcp2_conn_del(conn);
+
+  /* Retransmission splits CRYPTO frame */
+  setup_handshake_server(&conn);
+  conn->callbacks.recv_crypto_data = recv_crypto_data;
+
+  frs[0].type = NGTCP2_FRAME_CRYPTO;
+  frs[0].crypto.offset = 0;
+  frs[0].crypto.datacnt = 1;
+  frs[0].crypto.data[0].len = 123;
+  frs[0].crypto.data[0].base = null_data;
+
+  frs[1].type = NGTCP2_FRAME_PADDING;
+  frs[1].padding.len = 1005;
+
+  pktlen = write_handshake_pkt(buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid,
+                               ngtcp2_conn_get_dcid(conn), ++pkt_num,
+                               conn->client_chosen_version, frs, 2, &null_ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  /* Increase anti-amplification factor for easier testing */
+  conn->dcid.current.bytes_recv += 10000;
+
+  ngtcp2_conn_submit_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_INITIAL, null_data,
+                                 123);
+  ngtcp2_conn_submit_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_HANDSHAKE, null_data,
+                                 3000);
+  /* Initial and first Handshake are coalesced into 1 packet. */
+  for (i = 0; i < 3; ++i) {
+    spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+    CU_ASSERT(spktlen > 0);
+  }
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(0 == spktlen);
+
+  it = ngtcp2_rtb_head(&conn->hs_pktns->rtb);
+  ent = ngtcp2_rtb_it_get(&it);
+
+  CU_ASSERT(NGTCP2_FRAME_CRYPTO == ent->frc->fr.type);
+  CU_ASSERT(2170 == ent->frc->fr.crypto.offset);
+  CU_ASSERT(830 == ngtcp2_vec_len(ent->frc->fr.crypto.data,
+                                  ent->frc->fr.crypto.datacnt));
+  CU_ASSERT(2 == ent->hd.pkt_num);
+
+  t += 1000;
+
+  ngtcp2_conn_on_loss_detection_timer(conn, t);
+
+  /* 1st PTO */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  CU_ASSERT(spktlen > 0);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(0 == spktlen);
+
+  it = ngtcp2_rtb_head(&conn->hs_pktns->rtb);
+  ent = ngtcp2_rtb_it_get(&it);
+
+  CU_ASSERT(NGTCP2_FRAME_CRYPTO == ent->frc->fr.type);
+  CU_ASSERT(0 == ent->frc->fr.crypto.offset);
+  CU_ASSERT(987 == ngtcp2_vec_len(ent->frc->fr.crypto.data,
+                                  ent->frc->fr.crypto.datacnt));
+  CU_ASSERT(3 == ent->hd.pkt_num);
+
+  t += 1000;
+
+  ngtcp2_conn_on_loss_detection_timer(conn, t);
+
+  /* 2nd PTO.  Initial and Handshake packets are coalesced.  Handshake
+     CRYPTO is split into 2 because of Initial CRYPTO. */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  CU_ASSERT(spktlen > 0);
+
+  it = ngtcp2_rtb_head(&conn->hs_pktns->rtb);
+  ent = ngtcp2_rtb_it_get(&it);
+
+  CU_ASSERT(NGTCP2_FRAME_CRYPTO == ent->frc->fr.type);
+  CU_ASSERT(987 == ent->frc->fr.crypto.offset);
+  CU_ASSERT(991 == ngtcp2_vec_len(ent->frc->fr.crypto.data,
+                                  ent->frc->fr.crypto.datacnt));
+  CU_ASSERT(4 == ent->hd.pkt_num);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  CU_ASSERT(spktlen > 0);
+
+  it = ngtcp2_rtb_head(&conn->hs_pktns->rtb);
+  ent = ngtcp2_rtb_it_get(&it);
+
+  CU_ASSERT(NGTCP2_FRAME_CRYPTO == ent->frc->fr.type);
+  CU_ASSERT(1978 == ent->frc->fr.crypto.offset);
+  CU_ASSERT(192 == ngtcp2_vec_len(ent->frc->fr.crypto.data,
+                                  ent->frc->fr.crypto.datacnt));
+  CU_ASSERT(5 == ent->hd.pkt_num);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  CU_ASSERT(0 == spktlen);
+
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = 0;
+  fr.ack.ack_delay = 0;
+  fr.ack.ack_delay_unscaled = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_HANDSHAKE, &conn->oscid,
+      ngtcp2_conn_get_dcid(conn), ++pkt_num, conn->client_chosen_version, &fr,
+      &null_ckm);
+
+  t += 8;
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, t);
+
+  CU_ASSERT(0 == rv);
+
+  t += 1000;
+
+  ngtcp2_conn_on_loss_detection_timer(conn, t);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  CU_ASSERT(0 == spktlen);
+
+  it = ngtcp2_rtb_head(&conn->hs_pktns->rtb);
+  ent = ngtcp2_rtb_it_get(&it);
+
+  CU_ASSERT(NGTCP2_FRAME_CRYPTO == ent->frc->fr.type);
+  CU_ASSERT(2170 == ent->frc->fr.crypto.offset);
+  CU_ASSERT(830 == ngtcp2_vec_len(ent->frc->fr.crypto.data,
+                                  ent->frc->fr.crypto.datacnt));
+  CU_ASSERT(6 == ent->hd.pkt_num);
+  CU_ASSERT(NULL == ent->frc->next);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_amplification_limit(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_tstamp blocked_ts = 0;
+  ngtcp2_ssize spktlen;
+  ngtcp2_ssize datalen;
+  size_t pktlen;
+  uint8_t buf[1252];
+  ngtcp2_frame frs[2];
+  ngtcp2_cid rcid;
+  ngtcp2_transport_params params;
+  ngtcp2_crypto_aead_ctx aead_ctx = {0};
+  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
+  int64_t stream_id;
+  int rv;
+
+  rcid_init(&rcid);
+
+  frs[0].type = NGTCP2_FRAME_CRYPTO;
+  frs[0].crypto.offset = 0;
+  frs[0].crypto.datacnt = 1;
+  frs[0].crypto.data[0].len = 123;
+  frs[0].crypto.data[0].base = null_data;
+
+  frs[1].type = NGTCP2_FRAME_PADDING;
+  frs[1].padding.len = 1005;
+
+  /* Server waits for the client to send more bytes to send the rest
+     of Handshake CRYPTO data. */
+  setup_handshake_server(&conn);
+  conn->callbacks.recv_crypto_data = recv_crypto_data;
+
+  pktlen = write_handshake_pkt(buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid,
+                               ngtcp2_conn_get_dcid(conn), 0,
+                               conn->client_chosen_version, frs, 2, &null_ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_conn_submit_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_INITIAL,
+                                 null_data, 123);
+  ngtcp2_conn_submit_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_HANDSHAKE,
+                                 null_data, 4000);
+
+  for (;;) {
+    spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+    CU_ASSERT(spktlen >= 0);
+
+    if (spktlen <= 0) {
+      blocked_ts = t;
+      break;
+    }
+  }
+
+  CU_ASSERT(conn->dcid.current.bytes_sent <= pktlen * 3);
+  CU_ASSERT(conn->hs_pktns->crypto.tx.frq.len > 0);
+  CU_ASSERT(1 == conn->cstat.amplification_limited_count);
+  CU_ASSERT(0 == conn->cstat.amplification_limited_duration);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(0 == spktlen);
+  CU_ASSERT(1 == conn->cstat.amplification_limited_count);
+
+  frs[0].type = NGTCP2_FRAME_PING;
+
+  pktlen = write_handshake_pkt(buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid,
+                               ngtcp2_conn_get_dcid(conn), 1,
+                               conn->client_chosen_version, frs, 2, &null_ckm);
+
+  t += 1000;
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(t - blocked_ts == conn->cstat.amplification_limited_duration);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  ngtcp2_conn_del(conn);
+
+  /* With handshake_first, 1RTT packets leave the budget to
+     retransmit Initial and Handshake packets. */
+  setup_handshake_server(&conn);
+  conn->callbacks.recv_client_initial =
+      recv_client_initial_no_remote_transport_params;
+  conn->callbacks.recv_crypto_data = recv_crypto_data;
+  conn->local.settings.handshake_first = 1;
+
+  frs[0].type = NGTCP2_FRAME_CRYPTO;
+
+  pktlen = write_handshake_pkt(buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid,
+                               ngtcp2_conn_get_dcid(conn), 0,
+                               conn->client_chosen_version, frs, 2, &null_ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_transport_params_default(&params);
+  params.initial_scid = conn->dcid.current.cid;
+  params.original_dcid = conn->rcid;
+  params.initial_max_streams_uni = 1;
+  params.initial_max_stream_data_uni = 64 * 1024;
+  params.initial_max_data = 64 * 1024;
+
+  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+
+  CU_ASSERT(0 == rv);
+
+  rv = ngtcp2_conn_install_tx_key(conn, null_secret, sizeof(null_secret),
+                                  &aead_ctx, null_iv, sizeof(null_iv), &hp_ctx);
+
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_conn_submit_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_INITIAL,
+                                 null_data, 123);
+  ngtcp2_conn_submit_crypto_data(conn, NGTCP2_CRYPTO_LEVEL_HANDSHAKE,
+                                 null_data, 1000);
+
+  rv = ngtcp2_conn_open_uni_stream(conn, &stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  for (;;) {
+    spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                       &datalen, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                       stream_id, null_data, 4096, ++t);
+
+    CU_ASSERT(spktlen >= 0);
+
+    if (spktlen <= 0) {
+      break;
+    }
+  }
+
+  CU_ASSERT(0 == conn->hs_pktns->crypto.tx.frq.len);
+  CU_ASSERT(conn->pktns.rtb.cc_bytes_in_flight > 0);
+  CU_ASSERT(conn->dcid.current.bytes_sent +
+                conn->in_pktns->rtb.cc_bytes_in_flight +
+                conn->hs_pktns->rtb.cc_bytes_in_flight <=
+            pktlen * 3);
+  CU_ASSERT(0 == conn->cstat.amplification_limited_count);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_recv_client_initial_retry(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_frame fr;
+  int64_t pkt_num = -1;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_cid rcid;
+  int rv;
+
+  rcid_init(&rcid);
+
+  setup_handshake_server(&conn);
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 1;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 1245;
+  fr.crypto.data[0].base = null_data;
+
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &rcid, ngtcp2_conn_get_dcid(conn),
+      ++pkt_num, conn->client_chosen_version, &fr, &null_ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(NGTCP2_ERR_RETRY == rv);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_recv_client_initial_token(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_frame fr;
+  int64_t pkt_num = -1;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_cid rcid;
+  int rv;
+  const uint8_t raw_token[] = {0xff, 0x12, 0x31, 0x04, 0xab};
+  ngtcp2_vec token;
+  const ngtcp2_mem *mem;
+
+  rcid_init(&rcid);
+
+  setup_handshake_server(&conn);
+  mem = conn->mem;
+
+  token.base = ngtcp2_mem_malloc(mem, sizeof(raw_token));
+  memcpy(token.base, raw_token, sizeof(raw_token));
+  token.len = sizeof(raw_token);
+
+  conn->local.settings.token = token;
+
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 1181;
+  fr.crypto.data[0].base = null_data;
+
+  pktlen = write_single_frame_initial_pkt(
+      buf, sizeof(buf), &rcid, ngtcp2_conn_get_dcid(conn), ++pkt_num,
+      conn->client_chosen_version, &fr, raw_token, sizeof(raw_token),
+      &null_ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1181 == ngtcp2_strm_rx_offset(&conn->in_pktns->crypto.strm));
+
+  ngtcp2_conn_del(conn);
+
+  /* Specifying invalid token lets server drop the packet */
+  setup_handshake_server(&conn);
+  mem = conn->mem;
+
+  token.base = ngtcp2_mem_malloc(mem, sizeof(raw_token));
+  memcpy(token.base, raw_token, sizeof(raw_token));
+  token.len = sizeof(raw_token) - 1;
+
+  conn->local.settings.token = token;
+
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 1179;
+  fr.crypto.data[0].base = null_data;
+
+  pktlen = write_single_frame_initial_pkt(
+      buf, sizeof(buf), &rcid, ngtcp2_conn_get_dcid(conn), ++pkt_num,
+      conn->client_chosen_version, &fr, raw_token, sizeof(raw_token),
+      &null_ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(NGTCP2_ERR_DROP_CONN == rv);
+  CU_ASSERT(0 == ngtcp2_strm_rx_offset(&conn->in_pktns->crypto.strm));
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_get_active_dcid(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_cid_token cid_token[2];
+  ngtcp2_cid dcid;
+  static uint8_t token[] = {0xf1, 0xf1, 0xf1, 0xf1, 0xf1, 0xf1, 0xf1, 0xf1,
+                            0xf1, 0xf1, 0xf1, 0xf1, 0xf1, 0xf1, 0xf1, 0xf1};
+
+  dcid_init(&dcid);
+  setup_default_client(&conn);
+
+  CU_ASSERT(1 == ngtcp2_conn_get_num_active_dcid(conn));
+  CU_ASSERT(1 == ngtcp2_conn_get_active_dcid(conn, cid_token));
+  CU_ASSERT(0 == cid_token[0].seq);
+  CU_ASSERT(ngtcp2_cid_eq(&dcid, &cid_token[0].cid));
+  CU_ASSERT(ngtcp2_path_eq(&null_path.path, &cid_token[0].ps.path));
+  CU_ASSERT(1 == cid_token[0].token_present);
+  CU_ASSERT(0 ==
+            memcmp(token, cid_token[0].token, NGTCP2_STATELESS_RESET_TOKENLEN));
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_recv_version_negotiation(void) {
+  ngtcp2_conn *conn;
+  const ngtcp2_cid *dcid;
+  ngtcp2_ssize spktlen;
+  uint8_t buf[1500];
+  uint32_t nsv[3];
+  int rv;
+  ngtcp2_tstamp t = 0;
+
+  setup_handshake_client(&conn);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  dcid = ngtcp2_conn_get_dcid(conn);
+
+  nsv[0] = 0xffffffff;
+
+  spktlen = ngtcp2_pkt_write_version_negotiation(
+      buf, sizeof(buf), 0xfe, conn->oscid.data, conn->oscid.datalen, dcid->data,
+      dcid->datalen, nsv, 1);
+
+  CU_ASSERT(spktlen > 0);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
+                            (size_t)spktlen, ++t);
+
+  CU_ASSERT(NGTCP2_ERR_RECV_VERSION_NEGOTIATION == rv);
+
+  ngtcp2_conn_del(conn);
+
+  /* Ignore Version Negotiation if it contains version selected by
+     client */
+  setup_handshake_client(&conn);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  dcid = ngtcp2_conn_get_dcid(conn);
+
+  nsv[0] = 0xfffffff0;
+  nsv[1] = conn->client_chosen_version;
+
+  spktlen = ngtcp2_pkt_write_version_negotiation(
+      buf, sizeof(buf), 0x50, conn->oscid.data, conn->oscid.datalen, dcid->data,
+      dcid->datalen, nsv, 2);
+
+  CU_ASSERT(spktlen > 0);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
+                            (size_t)spktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_conn_del(conn);
+
+  /* Ignore Version Negotiation if client reacted upon Version
+     Negotiation */
+  setup_handshake_client(&conn);
+
+  conn->local.settings.original_version = NGTCP2_PROTO_VER_V2_DRAFT;
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  dcid = ngtcp2_conn_get_dcid(conn);
+
+  nsv[0] = 0xffffffff;
+
+  spktlen = ngtcp2_pkt_write_version_negotiation(
+      buf, sizeof(buf), 0xfe, conn->oscid.data, conn->oscid.datalen, dcid->data,
+      dcid->datalen, nsv, 1);
+
+  CU_ASSERT(spktlen > 0);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
+                            (size_t)spktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_send_initial_token(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  ngtcp2_callbacks cb;
+  ngtcp2_settings settings;
+  ngtcp2_transport_params params;
+  ngtcp2_cid rcid, scid;
+  ngtcp2_crypto_aead retry_aead = {0, NGTCP2_FAKE_AEAD_OVERHEAD};
+  uint8_t token[] = "this is token";
+  ngtcp2_ssize spktlen, shdlen;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_pkt_hd hd;
+  ngtcp2_crypto_aead_ctx aead_ctx = {0};
+  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
+  ngtcp2_crypto_ctx crypto_ctx;
+
+  rcid_init(&rcid);
+  scid_init(&scid);
+
+  init_initial_crypto_ctx(&crypto_ctx);
+
+  client_default_callbacks(&cb);
+  client_default_settings(&settings);
+  client_default_transport_params(&params);
+
+  settings.token.base = token;
+  settings.token.len = sizeof(token);
+
+  ngtcp2_conn_client_new(&conn, &rcid, &scid, &null_path.path,
+                         NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
+                         /* mem = */ NULL, NULL);
+  ngtcp2_conn_set_initial_crypto_ctx(conn, &crypto_ctx);
+  ngtcp2_conn_install_initial_key(conn, &aead_ctx, null_iv, &hp_ctx, &aead_ctx,
+                                  null_iv, &hp_ctx, sizeof(null_iv));
+  ngtcp2_conn_set_retry_aead(conn, &retry_aead, &aead_ctx);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  shdlen = ngtcp2_pkt_decode_hd_long(&hd, buf, (size_t)spktlen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(sizeof(token) == hd.token.len);
+  CU_ASSERT(0 == memcmp(token, hd.token.base, sizeof(token)));
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_set_remote_transport_params(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_transport_params params;
+  int rv;
+  ngtcp2_cid dcid;
+  uint8_t other_versions[2 * sizeof(uint32_t)];
+
+  dcid_init(&dcid);
+
+  /* client: Successful case */
+  setup_handshake_client(&conn);
+
+  conn->negotiated_version = conn->client_chosen_version;
+
+  memset(&params, 0, sizeof(params));
+  params.active_connection_id_limit = NGTCP2_DEFAULT_ACTIVE_CONNECTION_ID_LIMIT;
+  params.max_udp_payload_size = 1450;
+  params.initial_scid = conn->dcid.current.cid;
+  params.original_dcid = conn->rcid;
+
+  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_conn_del(conn);
+
+  /* client: Wrong original_dcid */
+  setup_handshake_client(&conn);
+
+  conn->negotiated_version = conn->client_chosen_version;
+
+  memset(&params, 0, sizeof(params));
+  params.active_connection_id_limit = NGTCP2_DEFAULT_ACTIVE_CONNECTION_ID_LIMIT;
+  params.max_udp_payload_size = 1450;
+  params.initial_scid = conn->dcid.current.cid;
+
+  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+
+  CU_ASSERT(NGTCP2_ERR_TRANSPORT_PARAM == rv);
+
+  ngtcp2_conn_del(conn);
+
+  /* client: Wrong initial_scid */
+  setup_handshake_client(&conn);
+
+  conn->negotiated_version = conn->client_chosen_version;
+
+  memset(&params, 0, sizeof(params));
+  params.active_connection_id_limit = NGTCP2_DEFAULT_ACTIVE_CONNECTION_ID_LIMIT;
+  params.max_udp_payload_size = 1450;
+  params.original_dcid = conn->rcid;
+
+  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+
+  CU_ASSERT(NGTCP2_ERR_TRANSPORT_PARAM == rv);
+
+  ngtcp2_conn_del(conn);
+
+  /* client: Receiving retry_scid when retry is not attempted */
+  setup_handshake_client(&conn);
+
+  conn->negotiated_version = conn->client_chosen_version;
+
+  memset(&params, 0, sizeof(params));
+  params.active_connection_id_limit = NGTCP2_DEFAULT_ACTIVE_CONNECTION_ID_LIMIT;
+  params.max_udp_payload_size = 1450;
+  params.initial_scid = conn->dcid.current.cid;
+  params.original_dcid = conn->rcid;
+  params.retry_scid_present = 1;
+
+  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+
+  CU_ASSERT(NGTCP2_ERR_TRANSPORT_PARAM == rv);
+
+  ngtcp2_conn_del(conn);
+
+  /* client: Receiving retry_scid */
+  setup_handshake_client(&conn);
+
+  conn->flags |= NGTCP2_CONN_FLAG_RECV_RETRY;
+  conn->retry_scid = dcid;
+  conn->negotiated_version = conn->client_chosen_version;
+
+  memset(&params, 0, sizeof(params));
+  params.active_connection_id_limit = NGTCP2_DEFAULT_ACTIVE_CONNECTION_ID_LIMIT;
+  params.max_udp_payload_size = 1450;
+  params.initial_scid = conn->dcid.current.cid;
+  params.original_dcid = conn->rcid;
+  params.retry_scid_present = 1;
+  params.retry_scid = dcid;
+
+  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_conn_del(conn);
+
+  /* client: Not receiving retry_scid when retry is attempted */
+  setup_handshake_client(&conn);
+
+  conn->flags |= NGTCP2_CONN_FLAG_RECV_RETRY;
+  conn->retry_scid = dcid;
+  conn->negotiated_version = conn->client_chosen_version;
+
+  memset(&params, 0, sizeof(params));
+  params.active_connection_id_limit = NGTCP2_DEFAULT_ACTIVE_CONNECTION_ID_LIMIT;
+  params.max_udp_payload_size = 1450;
+  params.initial_scid = conn->dcid.current.cid;
+  params.original_dcid = conn->rcid;
+
+  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+
+  CU_ASSERT(NGTCP2_ERR_TRANSPORT_PARAM == rv);
+
+  ngtcp2_conn_del(conn);
+
+  /* client: No version_information after Version Negotiation */
+  setup_handshake_client(&conn);
+
+  conn->local.settings.original_version = NGTCP2_PROTO_VER_V2_DRAFT;
+  conn->negotiated_version = conn->client_chosen_version;
+
+  memset(&params, 0, sizeof(params));
+  params.active_connection_id_limit = NGTCP2_DEFAULT_ACTIVE_CONNECTION_ID_LIMIT;
+  params.max_udp_payload_size = 1450;
+  params.initial_scid = conn->dcid.current.cid;
+  params.original_dcid = conn->rcid;
+
+  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+
+  CU_ASSERT(NGTCP2_ERR_VERSION_NEGOTIATION_FAILURE == rv);
+
+  ngtcp2_conn_del(conn);
+
+  /* client: other_versions includes the version that the client
+     initially attempted. */
+  setup_handshake_client(&conn);
+
+  conn->local.settings.original_version = NGTCP2_PROTO_VER_V2_DRAFT;
+  conn->negotiated_version = conn->client_chosen_version;
+
+  ngtcp2_put_uint32be(other_versions, NGTCP2_PROTO_VER_V1);
+  ngtcp2_put_uint32be(other_versions + sizeof(uint32_t),
+                      NGTCP2_PROTO_VER_V2_DRAFT);
+
+  memset(&params, 0, sizeof(params));
+  params.active_connection_id_limit = NGTCP2_DEFAULT_ACTIVE_CONNECTION_ID_LIMIT;
+  params.max_udp_payload_size = 1450;
+  params.initial_scid = conn->dcid.current.cid;
+  params.original_dcid = conn->rcid;
+  params.version_info_present = 1;
+  params.version_info.chosen_version = conn->negotiated_version;
+  params.version_info.other_versions = other_versions;
+  params.version_info.other_versionslen = 2 * sizeof(uint32_t);
+
+  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+
+  CU_ASSERT(NGTCP2_ERR_VERSION_NEGOTIATION_FAILURE == rv);
+
+  ngtcp2_conn_del(conn);
+
+  /* client: client is unable to choose client chosen version from
+     server's other_versions and chosen version. */
+  setup_handshake_client(&conn);
+
+  conn->local.settings.original_version = NGTCP2_PROTO_VER_V2_DRAFT;
+  conn->negotiated_version = 0xff000000u;
+
+  conn->local.settings.preferred_versions[0] = 0xff000001u;
+  conn->local.settings.preferred_versionslen = 1;
+
+  ngtcp2_put_uint32be(conn->vneg.other_versions, NGTCP2_PROTO_VER_V1);
+  ngtcp2_put_uint32be(conn->vneg.other_versions + sizeof(uint32_t),
+                      0xff000000u);
+
+  ngtcp2_put_uint32be(other_versions, 0xff000000u);
+
+  memset(&params, 0, sizeof(params));
+  params.active_connection_id_limit = NGTCP2_DEFAULT_ACTIVE_CONNECTION_ID_LIMIT;
+  params.max_udp_payload_size = 1450;
+  params.initial_scid = conn->dcid.current.cid;
+  params.original_dcid = conn->rcid;
+  params.version_info_present = 1;
+  params.version_info.chosen_version = conn->negotiated_version;
+  params.version_info.other_versions = other_versions;
+  params.version_info.other_versionslen = 1;
+
+  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+
+  CU_ASSERT(NGTCP2_ERR_VERSION_NEGOTIATION_FAILURE == rv);
+
+  ngtcp2_conn_del(conn);
+
+  /* client: client chooses version which differs from client chosen
+     version from server's other_versions and chosen version. */
+  setup_handshake_client(&conn);
+
+  conn->local.settings.original_version = NGTCP2_PROTO_VER_V2_DRAFT;
+  conn->negotiated_version = 0xff000000u;
+
+  conn->local.settings.preferred_versions[0] = 0xff000000u;
+  conn->local.settings.preferred_versionslen = 1;
+
+  ngtcp2_put_uint32be(conn->vneg.other_versions, NGTCP2_PROTO_VER_V1);
+  ngtcp2_put_uint32be(conn->vneg.other_versions + sizeof(uint32_t),
+                      0xff000000u);
+
+  ngtcp2_put_uint32be(other_versions, 0xff000000u);
+
+  memset(&params, 0, sizeof(params));
+  params.active_connection_id_limit = NGTCP2_DEFAULT_ACTIVE_CONNECTION_ID_LIMIT;
+  params.max_udp_payload_size = 1450;
+  params.initial_scid = conn->dcid.current.cid;
+  params.original_dcid = conn->rcid;
+  params.version_info_present = 1;
+  params.version_info.chosen_version = conn->negotiated_version;
+  params.version_info.other_versions = other_versions;
+  params.version_info.other_versionslen = 1;
+
+  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+
+  CU_ASSERT(NGTCP2_ERR_VERSION_NEGOTIATION_FAILURE == rv);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_write_connection_close(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[1200];
+  ngtcp2_ssize spktlen, shdlen;
+  ngtcp2_pkt_hd hd;
+  const uint8_t *p;
+  ngtcp2_crypto_aead_ctx aead_ctx = {0};
+  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
+  ngtcp2_crypto_ctx crypto_ctx;
+  ngtcp2_connection_close_error ccerr;
+
+  /* Client only Initial key */
+  setup_handshake_client(&conn);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 0);
+
+  CU_ASSERT(spktlen > 0);
+
+  ngtcp2_connection_close_error_set_transport_error(&ccerr, NGTCP2_NO_ERROR,
+                                                    (const uint8_t *)"foo", 3);
+
+  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
+                                               sizeof(buf), &ccerr, 0);
+
+  CU_ASSERT(spktlen >= NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+
+  shdlen = ngtcp2_pkt_decode_hd_long(&hd, buf, (size_t)spktlen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_INITIAL == hd.type);
+  CU_ASSERT(shdlen + (ngtcp2_ssize)hd.len == spktlen);
+
+  ngtcp2_conn_del(conn);
+
+  /* Client has Initial and Handshake keys */
+  setup_handshake_client(&conn);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 0);
+
+  CU_ASSERT(spktlen > 0);
+
+  init_crypto_ctx(&crypto_ctx);
+
+  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
+  conn->negotiated_version = conn->client_chosen_version;
+  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
+                                       sizeof(null_iv), &hp_ctx);
+
+  ngtcp2_connection_close_error_set_transport_error_liberr(&ccerr, 0, NULL, 0);
+
+  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
+                                               sizeof(buf), &ccerr, 0);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+
+  shdlen = ngtcp2_pkt_decode_hd_long(&hd, buf, (size_t)spktlen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_HANDSHAKE == hd.type);
+  CU_ASSERT(shdlen + (ngtcp2_ssize)hd.len == spktlen);
+
+  ngtcp2_conn_del(conn);
+
+  /* Client has all keys and has not confirmed handshake */
+  setup_handshake_client(&conn);
+
+  init_crypto_ctx(&crypto_ctx);
+
+  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
+  conn->negotiated_version = conn->client_chosen_version;
+  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
+                                       sizeof(null_iv), &hp_ctx);
+  ngtcp2_conn_install_tx_key(conn, null_secret, sizeof(null_secret), &aead_ctx,
+                             null_iv, sizeof(null_iv), &hp_ctx);
+
+  conn->state = NGTCP2_CS_POST_HANDSHAKE;
+
+  ngtcp2_connection_close_error_set_transport_error(&ccerr, NGTCP2_NO_ERROR,
+                                                    NULL, 0);
+
+  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
+                                               sizeof(buf), &ccerr, 0);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+
+  p = buf;
+
+  shdlen = ngtcp2_pkt_decode_hd_long(&hd, p, (size_t)spktlen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_HANDSHAKE == hd.type);
+
+  p += shdlen + (ngtcp2_ssize)hd.len;
+  spktlen -= shdlen + (ngtcp2_ssize)hd.len;
+
+  shdlen = ngtcp2_pkt_decode_hd_short(&hd, p, (size_t)spktlen,
+                                      conn->dcid.current.cid.datalen);
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_1RTT == hd.type);
+
+  ngtcp2_conn_del(conn);
+
+  /* Client has confirmed handshake */
+  setup_default_client(&conn);
+
+  ngtcp2_connection_close_error_set_transport_error(&ccerr, NGTCP2_NO_ERROR,
+                                                    NULL, 0);
+
+  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
+                                               sizeof(buf), &ccerr, 0);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+
+  shdlen = ngtcp2_pkt_decode_hd_short(&hd, buf, (size_t)spktlen,
+                                      conn->dcid.current.cid.datalen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_1RTT == hd.type);
+
+  ngtcp2_conn_del(conn);
+
+  /* Server has Initial and Handshake key */
+  setup_handshake_server(&conn);
+
+  conn->dcid.current.bytes_recv = NGTCP2_MAX_UDP_PAYLOAD_SIZE;
+
+  init_initial_crypto_ctx(&crypto_ctx);
+
+  ngtcp2_conn_set_initial_crypto_ctx(conn, &crypto_ctx);
+  ngtcp2_conn_install_initial_key(conn, &aead_ctx, null_iv, &hp_ctx, &aead_ctx,
+                                  null_iv, &hp_ctx, sizeof(null_iv));
+
+  init_crypto_ctx(&crypto_ctx);
+
+  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
+  conn->negotiated_version = conn->client_chosen_version;
+  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
+                                       sizeof(null_iv), &hp_ctx);
+
+  ngtcp2_connection_close_error_set_transport_error(&ccerr, NGTCP2_NO_ERROR,
+                                                    NULL, 0);
+
+  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
+                                               sizeof(buf), &ccerr, 0);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+
+  p = buf;
+
+  shdlen = ngtcp2_pkt_decode_hd_long(&hd, p, (size_t)spktlen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_INITIAL == hd.type);
+
+  p += shdlen + (ngtcp2_ssize)hd.len;
+  spktlen -= shdlen + (ngtcp2_ssize)hd.len;
+
+  shdlen = ngtcp2_pkt_decode_hd_long(&hd, p, (size_t)spktlen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_HANDSHAKE == hd.type);
+  CU_ASSERT(shdlen + (ngtcp2_ssize)hd.len == spktlen);
+
+  ngtcp2_conn_del(conn);
+
+  /* Server has all keys and has not confirmed handshake */
+  setup_handshake_server(&conn);
+
+  conn->dcid.current.bytes_recv = NGTCP2_MAX_UDP_PAYLOAD_SIZE;
+
+  init_initial_crypto_ctx(&crypto_ctx);
+
+  ngtcp2_conn_set_initial_crypto_ctx(conn, &crypto_ctx);
+  ngtcp2_conn_install_initial_key(conn, &aead_ctx, null_iv, &hp_ctx, &aead_ctx,
+                                  null_iv, &hp_ctx, sizeof(null_iv));
+
+  init_crypto_ctx(&crypto_ctx);
+
+  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
+  conn->negotiated_version = conn->client_chosen_version;
+  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
+                                       sizeof(null_iv), &hp_ctx);
+  ngtcp2_conn_install_tx_key(conn, null_secret, sizeof(null_secret), &aead_ctx,
+                             null_iv, sizeof(null_iv), &hp_ctx);
+
+  conn->state = NGTCP2_CS_POST_HANDSHAKE;
+
+  ngtcp2_connection_close_error_set_transport_error(&ccerr, NGTCP2_NO_ERROR,
+                                                    NULL, 0);
+
+  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
+                                               sizeof(buf), &ccerr, 0);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+
+  p = buf;
+
+  shdlen = ngtcp2_pkt_decode_hd_long(&hd, p, (size_t)spktlen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_INITIAL == hd.type);
+
+  p += shdlen + (ngtcp2_ssize)hd.len;
+  spktlen -= shdlen + (ngtcp2_ssize)hd.len;
+
+  shdlen = ngtcp2_pkt_decode_hd_long(&hd, p, (size_t)spktlen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_HANDSHAKE == hd.type);
+
+  p += shdlen + (ngtcp2_ssize)hd.len;
+  spktlen -= shdlen + (ngtcp2_ssize)hd.len;
+
+  shdlen = ngtcp2_pkt_decode_hd_short(&hd, p, (size_t)spktlen,
+                                      conn->dcid.current.cid.datalen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_1RTT == hd.type);
+
+  ngtcp2_conn_del(conn);
+
+  /* Server has confirmed handshake */
+  setup_default_server(&conn);
+
+  ngtcp2_connection_close_error_set_transport_error(&ccerr, NGTCP2_NO_ERROR,
+                                                    NULL, 0);
+
+  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
+                                               sizeof(buf), &ccerr, 0);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+
+  shdlen = ngtcp2_pkt_decode_hd_short(&hd, buf, (size_t)spktlen,
+                                      conn->dcid.current.cid.datalen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_1RTT == hd.type);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_write_application_close(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[1200];
+  ngtcp2_ssize spktlen, shdlen;
+  ngtcp2_pkt_hd hd;
+  const uint8_t *p;
+  ngtcp2_crypto_aead_ctx aead_ctx = {0};
+  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
+  uint64_t app_err_code = 0;
+  ngtcp2_crypto_ctx crypto_ctx;
+  ngtcp2_connection_close_error ccerr;
+
+  /* Client only Initial key */
+  setup_handshake_client(&conn);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 0);
+
+  CU_ASSERT(spktlen > 0);
+
+  ngtcp2_connection_close_error_set_application_error(
+      &ccerr, app_err_code, (const uint8_t *)"foo", 3);
+
+  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
+                                               sizeof(buf), &ccerr, 0);
+
+  CU_ASSERT(spktlen >= NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+
+  shdlen = ngtcp2_pkt_decode_hd_long(&hd, buf, (size_t)spktlen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_INITIAL == hd.type);
+  CU_ASSERT(shdlen + (ngtcp2_ssize)hd.len == spktlen);
+
+  ngtcp2_conn_del(conn);
+
+  /* Client has Initial and Handshake keys */
+  setup_handshake_client(&conn);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), 0);
+
+  CU_ASSERT(spktlen > 0);
+
+  init_crypto_ctx(&crypto_ctx);
+
+  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
+  conn->negotiated_version = conn->client_chosen_version;
+  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
+                                       sizeof(null_iv), &hp_ctx);
+
+  ngtcp2_connection_close_error_set_application_error(&ccerr, app_err_code,
+                                                      NULL, 0);
+
+  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
+                                               sizeof(buf), &ccerr, 0);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+
+  shdlen = ngtcp2_pkt_decode_hd_long(&hd, buf, (size_t)spktlen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_HANDSHAKE == hd.type);
+  CU_ASSERT(shdlen + (ngtcp2_ssize)hd.len == spktlen);
+
+  ngtcp2_conn_del(conn);
+
+  /* Client has all keys and has not confirmed handshake */
+  setup_handshake_client(&conn);
+
+  init_crypto_ctx(&crypto_ctx);
+
+  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
+  conn->negotiated_version = conn->client_chosen_version;
+  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
+                                       sizeof(null_iv), &hp_ctx);
+  ngtcp2_conn_install_tx_key(conn, null_secret, sizeof(null_secret), &aead_ctx,
+                             null_iv, sizeof(null_iv), &hp_ctx);
+
+  conn->state = NGTCP2_CS_POST_HANDSHAKE;
+
+  ngtcp2_connection_close_error_set_application_error(&ccerr, app_err_code,
+                                                      NULL, 0);
+
+  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
+                                               sizeof(buf), &ccerr, 0);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+
+  p = buf;
+
+  shdlen = ngtcp2_pkt_decode_hd_long(&hd, p, (size_t)spktlen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_HANDSHAKE == hd.type);
+
+  p += shdlen + (ngtcp2_ssize)hd.len;
+  spktlen -= shdlen + (ngtcp2_ssize)hd.len;
+
+  shdlen = ngtcp2_pkt_decode_hd_short(&hd, p, (size_t)spktlen,
+                                      conn->dcid.current.cid.datalen);
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_1RTT == hd.type);
+
+  ngtcp2_conn_del(conn);
+
+  /* Client has confirmed handshake */
+  setup_default_client(&conn);
+
+  ngtcp2_connection_close_error_set_application_error(&ccerr, app_err_code,
+                                                      NULL, 0);
+
+  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
+                                               sizeof(buf), &ccerr, 0);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+
+  shdlen = ngtcp2_pkt_decode_hd_short(&hd, buf, (size_t)spktlen,
+                                      conn->dcid.current.cid.datalen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_1RTT == hd.type);
+
+  ngtcp2_conn_del(conn);
+
+  /* Server has Initial and Handshake key */
+  setup_handshake_server(&conn);
+
+  conn->dcid.current.bytes_recv = NGTCP2_MAX_UDP_PAYLOAD_SIZE;
+
+  init_initial_crypto_ctx(&crypto_ctx);
+
+  ngtcp2_conn_set_initial_crypto_ctx(conn, &crypto_ctx);
+  ngtcp2_conn_install_initial_key(conn, &aead_ctx, null_iv, &hp_ctx, &aead_ctx,
+                                  null_iv, &hp_ctx, sizeof(null_iv));
+
+  init_crypto_ctx(&crypto_ctx);
+
+  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
+  conn->negotiated_version = conn->client_chosen_version;
+  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
+                                       sizeof(null_iv), &hp_ctx);
+
+  ngtcp2_connection_close_error_set_application_error(&ccerr, app_err_code,
+                                                      NULL, 0);
+
+  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
+                                               sizeof(buf), &ccerr, 0);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+
+  p = buf;
+
+  shdlen = ngtcp2_pkt_decode_hd_long(&hd, p, (size_t)spktlen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_INITIAL == hd.type);
+
+  p += shdlen + (ngtcp2_ssize)hd.len;
+  spktlen -= shdlen + (ngtcp2_ssize)hd.len;
+
+  shdlen = ngtcp2_pkt_decode_hd_long(&hd, p, (size_t)spktlen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_HANDSHAKE == hd.type);
+  CU_ASSERT(shdlen + (ngtcp2_ssize)hd.len == spktlen);
+
+  ngtcp2_conn_del(conn);
+
+  /* Server has all keys and has not confirmed handshake */
+  setup_handshake_server(&conn);
+
+  conn->dcid.current.bytes_recv = NGTCP2_MAX_UDP_PAYLOAD_SIZE;
+
+  init_initial_crypto_ctx(&crypto_ctx);
+
+  ngtcp2_conn_set_initial_crypto_ctx(conn, &crypto_ctx);
+  ngtcp2_conn_install_initial_key(conn, &aead_ctx, null_iv, &hp_ctx, &aead_ctx,
+                                  null_iv, &hp_ctx, sizeof(null_iv));
+
+  init_crypto_ctx(&crypto_ctx);
+
+  ngtcp2_conn_set_crypto_ctx(conn, &crypto_ctx);
+  conn->negotiated_version = conn->client_chosen_version;
+  ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
+                                       sizeof(null_iv), &hp_ctx);
+  ngtcp2_conn_install_tx_key(conn, null_secret, sizeof(null_secret), &aead_ctx,
+                             null_iv, sizeof(null_iv), &hp_ctx);
+
+  ngtcp2_connection_close_error_set_application_error(&ccerr, app_err_code,
+                                                      NULL, 0);
+
+  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
+                                               sizeof(buf), &ccerr, 0);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+
+  p = buf;
+
+  shdlen = ngtcp2_pkt_decode_hd_long(&hd, p, (size_t)spktlen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_INITIAL == hd.type);
+
+  p += shdlen + (ngtcp2_ssize)hd.len;
+  spktlen -= shdlen + (ngtcp2_ssize)hd.len;
+
+  shdlen = ngtcp2_pkt_decode_hd_long(&hd, p, (size_t)spktlen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_HANDSHAKE == hd.type);
+
+  p += shdlen + (ngtcp2_ssize)hd.len;
+  spktlen -= shdlen + (ngtcp2_ssize)hd.len;
+
+  shdlen = ngtcp2_pkt_decode_hd_short(&hd, p, (size_t)spktlen,
+                                      conn->dcid.current.cid.datalen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_1RTT == hd.type);
+
+  ngtcp2_conn_del(conn);
+
+  /* Server has confirmed handshake */
+  setup_default_server(&conn);
+
+  ngtcp2_connection_close_error_set_application_error(&ccerr, app_err_code,
+                                                      NULL, 0);
+
+  spktlen = ngtcp2_conn_write_connection_close(conn, NULL, NULL, buf,
+                                               sizeof(buf), &ccerr, 0);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(spktlen < NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+
+  shdlen = ngtcp2_pkt_decode_hd_short(&hd, buf, (size_t)spktlen,
+                                      conn->dcid.current.cid.datalen);
+
+  CU_ASSERT(shdlen > 0);
+  CU_ASSERT(NGTCP2_PKT_1RTT == hd.type);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_rtb_reclaim_on_pto(void) {
+  ngtcp2_conn *conn;
+  int rv;
+  int64_t stream_id;
+  uint8_t buf[2048];
+  ngtcp2_ssize nwrite;
+  ngtcp2_ssize spktlen;
+  size_t i;
+  size_t num_reclaim_pkt;
+  ngtcp2_rtb_entry *ent;
+  ngtcp2_rtb_it it;
+
+  setup_default_client(&conn);
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  for (i = 0; i < 5; ++i) {
+    spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                       &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                       stream_id, null_data, 1024, 1);
+
+    CU_ASSERT(0 < spktlen);
+  }
+
+  CU_ASSERT(5 == conn->pktns.rtb.ents.len);
+
+  rv = ngtcp2_conn_on_loss_detection_timer(conn, 3 * NGTCP2_SECONDS);
+
+  CU_ASSERT(0 == rv);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf),
+                                  3 * NGTCP2_SECONDS);
+
+  CU_ASSERT(spktlen > 0);
+
+  it = ngtcp2_rtb_head(&conn->pktns.rtb);
+  num_reclaim_pkt = 0;
+  for (; !ngtcp2_rtb_it_end(&it); ngtcp2_rtb_it_next(&it)) {
+    ent = ngtcp2_rtb_it_get(&it);
+    if (ent->flags & NGTCP2_RTB_ENTRY_FLAG_PTO_RECLAIMED) {
+      ++num_reclaim_pkt;
+    }
+  }
+
+  CU_ASSERT(1 == num_reclaim_pkt);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_pto_probe_policy(void) {
+  ngtcp2_conn *conn;
+  int rv;
+  int64_t stream_id;
+  uint8_t buf[2048];
+  ngtcp2_ssize nwrite;
+  ngtcp2_ssize spktlen;
+  size_t i;
+  size_t num_reclaim_pkt;
+  ngtcp2_rtb_entry *ent;
+  ngtcp2_rtb_it it;
+  int64_t reclaimed_pkt_num;
+  const struct {
+    ngtcp2_pto_probe_policy policy;
+    size_t num_reclaim_pkt;
+    int64_t reclaimed_pkt_num;
+  } tests[] = {
+      {NGTCP2_PTO_PROBE_POLICY_NEW_DATA_FIRST, 0, -1},
+      {NGTCP2_PTO_PROBE_POLICY_RETRANSMIT_OLDEST, 1, 0},
+      {NGTCP2_PTO_PROBE_POLICY_DUPLICATE_LATEST, 1, 4},
+  };
+  size_t j;
+
+  for (j = 0; j < arraylen(tests); ++j) {
+    setup_default_client(&conn);
+
+    conn->local.settings.pto_probe_policy = tests[j].policy;
+
+    rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+    CU_ASSERT(0 == rv);
+
+    for (i = 0; i < 5; ++i) {
+      spktlen = ngtcp2_conn_write_stream(
+          conn, NULL, NULL, buf, sizeof(buf), &nwrite,
+          NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id, null_data, 1024, 1);
+
+      CU_ASSERT(0 < spktlen);
+    }
+
+    CU_ASSERT(5 == conn->pktns.rtb.ents.len);
+
+    rv = ngtcp2_conn_on_loss_detection_timer(conn, 3 * NGTCP2_SECONDS);
+
+    CU_ASSERT(0 == rv);
+    CU_ASSERT(2 == conn->pktns.rtb.probe_pkt_left);
+
+    /* The probe packet carries new data in all policies. */
+    spktlen = ngtcp2_conn_write_stream(
+        conn, NULL, NULL, buf, sizeof(buf), &nwrite,
+        NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id, null_data, 1024,
+        3 * NGTCP2_SECONDS);
+
+    CU_ASSERT(0 < spktlen);
+    CU_ASSERT(0 < nwrite);
+    CU_ASSERT(1 == conn->pktns.rtb.probe_pkt_left);
+
+    it = ngtcp2_rtb_head(&conn->pktns.rtb);
+    num_reclaim_pkt = 0;
+    reclaimed_pkt_num = -1;
+    for (; !ngtcp2_rtb_it_end(&it); ngtcp2_rtb_it_next(&it)) {
+      ent = ngtcp2_rtb_it_get(&it);
+      if (ent->flags & NGTCP2_RTB_ENTRY_FLAG_PTO_RECLAIMED) {
+        ++num_reclaim_pkt;
+        reclaimed_pkt_num = ent->hd.pkt_num;
+      }
+    }
+
+    CU_ASSERT(tests[j].num_reclaim_pkt == num_reclaim_pkt);
+    CU_ASSERT(tests[j].reclaimed_pkt_num == reclaimed_pkt_num);
+
+    ngtcp2_conn_del(conn);
+  }
+}
+
+void test_ngtcp2_conn_rtb_reclaim_on_pto_datagram(void) {
+  ngtcp2_conn *conn;
+  int rv;
+  int64_t stream_id;
+  uint8_t buf[2048];
+  ngtcp2_ssize nwrite;
+  ngtcp2_ssize spktlen;
+  size_t num_reclaim_pkt;
+  ngtcp2_rtb_entry *ent;
+  ngtcp2_rtb_it it;
+  ngtcp2_vec datav;
+  int accepted;
+  ngtcp2_frame_chain *frc;
+
+  /* DATAGRAM frame must not be reclaimed on PTO */
+  setup_default_client(&conn);
+
+  conn->callbacks.ack_datagram = ack_datagram;
+  conn->remote.transport_params->max_datagram_frame_size = 65535;
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, null_data, 1024, 1);
+
+  CU_ASSERT(0 < spktlen);
+
+  datav.base = null_data;
+  datav.len = 10;
+
+  spktlen = ngtcp2_conn_writev_datagram(
+      conn, NULL, NULL, buf, sizeof(buf), &accepted,
+      NGTCP2_WRITE_DATAGRAM_FLAG_NONE, 1000000007, &datav, 1, 1);
+
+  CU_ASSERT(accepted);
+  CU_ASSERT(0 < spktlen);
+  CU_ASSERT(2 == conn->pktns.rtb.ents.len);
+
+  rv = ngtcp2_conn_on_loss_detection_timer(conn, 3 * NGTCP2_SECONDS);
+
+  CU_ASSERT(0 == rv);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf),
+                                  3 * NGTCP2_SECONDS);
+
+  CU_ASSERT(spktlen > 0);
+
+  it = ngtcp2_rtb_head(&conn->pktns.rtb);
+  num_reclaim_pkt = 0;
+  for (; !ngtcp2_rtb_it_end(&it); ngtcp2_rtb_it_next(&it)) {
+    ent = ngtcp2_rtb_it_get(&it);
+    if (ent->flags & NGTCP2_RTB_ENTRY_FLAG_PTO_RECLAIMED) {
+      ++num_reclaim_pkt;
+      for (frc = ent->frc; frc; frc = frc->next) {
+        CU_ASSERT(NGTCP2_FRAME_DATAGRAM != frc->fr.type);
+      }
+    }
+  }
+
+  CU_ASSERT(1 == num_reclaim_pkt);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_validate_ecn(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  ngtcp2_ssize spktlen;
+  ngtcp2_pkt_info pi;
+  size_t pktlen;
+  int rv;
+  ngtcp2_frame fr;
+  int64_t stream_id;
+  ngtcp2_ssize nwrite;
+  size_t i;
+  ngtcp2_tstamp t = 0;
+  uint64_t cwnd;
+
+  setup_default_client(&conn);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, &pi, buf, sizeof(buf), 1);
+
+  CU_ASSERT(0 < spktlen);
+  CU_ASSERT(NGTCP2_ECN_ECT_0 == pi.ecn);
+  CU_ASSERT(NGTCP2_ECN_STATE_TESTING == conn->tx.ecn.state);
+  CU_ASSERT(1 == conn->tx.ecn.validation_start_ts);
+  CU_ASSERT(0 == conn->pktns.tx.ecn.start_pkt_num);
+
+  fr.type = NGTCP2_FRAME_ACK_ECN;
+  fr.ack.largest_ack = 0;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+  fr.ack.ecn.ect0 = 1;
+  fr.ack.ecn.ect1 = 0;
+  fr.ack.ecn.ce = 0;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_ECN_STATE_CAPABLE == conn->tx.ecn.state);
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf), &nwrite,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 1024, 2);
+
+  CU_ASSERT(0 < spktlen);
+
+  /* Receiving ACK frame containing less ECN counts fails
+     validation */
+  fr.type = NGTCP2_FRAME_ACK_ECN;
+  fr.ack.largest_ack = 1;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+  fr.ack.ecn.ect0 = 0;
+  fr.ack.ecn.ect1 = 0;
+  fr.ack.ecn.ce = 0;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 3);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_ECN_STATE_FAILED == conn->tx.ecn.state);
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf), &nwrite,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 1024, 2);
+
+  CU_ASSERT(0 < spktlen);
+  CU_ASSERT(NGTCP2_ECN_NOT_ECT == pi.ecn);
+
+  ngtcp2_conn_del(conn);
+
+  /* Receiving ACK frame without ECN counts invalidates ECN
+     capability */
+  setup_default_server(&conn);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, &pi, buf, sizeof(buf), 1);
+
+  CU_ASSERT(0 < spktlen);
+  CU_ASSERT(NGTCP2_ECN_ECT_0 == pi.ecn);
+  CU_ASSERT(NGTCP2_ECN_STATE_TESTING == conn->tx.ecn.state);
+  CU_ASSERT(1 == conn->tx.ecn.validation_start_ts);
+  CU_ASSERT(0 == conn->pktns.tx.ecn.start_pkt_num);
+
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = 0;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_ECN_STATE_FAILED == conn->tx.ecn.state);
+
+  ngtcp2_conn_del(conn);
+
+  /* CE counts must be considered */
+  setup_default_client(&conn);
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  for (i = 0; i < 2; ++i) {
+    spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf),
+                                       &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                       stream_id, null_data, 1024, 2);
+
+    CU_ASSERT(0 < spktlen);
+    CU_ASSERT(NGTCP2_ECN_ECT_0 == pi.ecn);
+  }
+
+  CU_ASSERT(NGTCP2_ECN_STATE_TESTING == conn->tx.ecn.state);
+  CU_ASSERT(2 == conn->tx.ecn.validation_start_ts);
+  CU_ASSERT(0 == conn->pktns.tx.ecn.start_pkt_num);
+
+  fr.type = NGTCP2_FRAME_ACK_ECN;
+  fr.ack.largest_ack = 1;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 1;
+  fr.ack.num_blks = 0;
+  fr.ack.ecn.ect0 = 1;
+  fr.ack.ecn.ect1 = 0;
+  fr.ack.ecn.ce = 1;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_ECN_STATE_CAPABLE == conn->tx.ecn.state);
+  CU_ASSERT(0 == conn->pktns.rtb.ents.len);
+
+  ngtcp2_conn_del(conn);
+
+  /* If increments of ECN counts is less than the number of
+     acknowledged ECN entries, ECN validation fails. */
+  setup_default_client(&conn);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, &pi, buf, sizeof(buf), 1);
+
+  CU_ASSERT(0 < spktlen);
+  CU_ASSERT(NGTCP2_ECN_ECT_0 == pi.ecn);
+  CU_ASSERT(NGTCP2_ECN_STATE_TESTING == conn->tx.ecn.state);
+  CU_ASSERT(1 == conn->tx.ecn.validation_start_ts);
+  CU_ASSERT(0 == conn->pktns.tx.ecn.start_pkt_num);
+
+  fr.type = NGTCP2_FRAME_ACK_ECN;
+  fr.ack.largest_ack = 0;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+  fr.ack.ecn.ect0 = 0;
+  fr.ack.ecn.ect1 = 1;
+  fr.ack.ecn.ce = 0;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_ECN_STATE_FAILED == conn->tx.ecn.state);
+
+  ngtcp2_conn_del(conn);
+
+  /* If ECT count is larger than the number of ECT marked packet, ECN
+     validation fails. */
+  setup_default_client(&conn);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, &pi, buf, sizeof(buf), 1);
+
+  CU_ASSERT(0 < spktlen);
+  CU_ASSERT(NGTCP2_ECN_ECT_0 == pi.ecn);
+  CU_ASSERT(NGTCP2_ECN_STATE_TESTING == conn->tx.ecn.state);
+  CU_ASSERT(1 == conn->tx.ecn.validation_start_ts);
+  CU_ASSERT(0 == conn->pktns.tx.ecn.start_pkt_num);
+
+  fr.type = NGTCP2_FRAME_ACK_ECN;
+  fr.ack.largest_ack = 0;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+  fr.ack.ecn.ect0 = 2;
+  fr.ack.ecn.ect1 = 0;
+  fr.ack.ecn.ce = 0;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_ECN_STATE_FAILED == conn->tx.ecn.state);
+
+  ngtcp2_conn_del(conn);
+
+  /* ECN validation fails if all ECN marked packets are lost */
+  setup_default_client(&conn);
+
+  t = 0;
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  for (i = 0; i < NGTCP2_ECN_MAX_NUM_VALIDATION_PKTS; ++i) {
+    spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf),
+                                       &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                       stream_id, null_data, 25, t);
+
+    CU_ASSERT(0 < spktlen);
+    CU_ASSERT(NGTCP2_ECN_ECT_0 == pi.ecn);
+  }
+
+  CU_ASSERT(NGTCP2_ECN_STATE_UNKNOWN == conn->tx.ecn.state);
+  CU_ASSERT(NGTCP2_ECN_MAX_NUM_VALIDATION_PKTS == conn->tx.ecn.dgram_sent);
+
+  t += NGTCP2_MILLISECONDS;
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf), &nwrite,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 25, t);
+
+  CU_ASSERT(0 < spktlen);
+  CU_ASSERT(NGTCP2_ECN_NOT_ECT == pi.ecn);
+  CU_ASSERT(NGTCP2_ECN_STATE_UNKNOWN == conn->tx.ecn.state);
+  CU_ASSERT(0 == conn->tx.ecn.validation_start_ts);
+  CU_ASSERT(0 == conn->pktns.tx.ecn.start_pkt_num);
+  CU_ASSERT(NGTCP2_ECN_MAX_NUM_VALIDATION_PKTS == conn->tx.ecn.dgram_sent);
+  CU_ASSERT(0 == conn->pktns.tx.ecn.validation_pkt_lost);
+
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = NGTCP2_ECN_MAX_NUM_VALIDATION_PKTS;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+
+  t += NGTCP2_MILLISECONDS;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, t);
+
+  CU_ASSERT(0 == rv);
+
+  CU_ASSERT(NGTCP2_ECN_STATE_FAILED == conn->tx.ecn.state);
+  CU_ASSERT(NGTCP2_ECN_MAX_NUM_VALIDATION_PKTS ==
+            conn->pktns.tx.ecn.validation_pkt_lost);
+
+  ngtcp2_conn_del(conn);
+
+  /* ECN validation fails if all ECN marked packets sent in last 3 *
+     RTT are lost */
+  setup_default_client(&conn);
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  for (i = 0; i < 2; ++i) {
+    spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf),
+                                       &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                       stream_id, null_data, 25, 0);
+
+    CU_ASSERT(0 < spktlen);
+    CU_ASSERT(NGTCP2_ECN_ECT_0 == pi.ecn);
+  }
+
+  CU_ASSERT(NGTCP2_ECN_STATE_TESTING == conn->tx.ecn.state);
+  CU_ASSERT(2 == conn->tx.ecn.dgram_sent);
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf), &nwrite,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 25, 3 * NGTCP2_SECONDS);
+
+  CU_ASSERT(0 < spktlen);
+  CU_ASSERT(NGTCP2_ECN_NOT_ECT == pi.ecn);
+  CU_ASSERT(NGTCP2_ECN_STATE_UNKNOWN == conn->tx.ecn.state);
+  CU_ASSERT(0 == conn->tx.ecn.validation_start_ts);
+  CU_ASSERT(0 == conn->pktns.tx.ecn.start_pkt_num);
+  CU_ASSERT(2 == conn->pktns.tx.ecn.validation_pkt_sent);
+  CU_ASSERT(0 == conn->pktns.tx.ecn.validation_pkt_lost);
+
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = 2;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen,
+                            4 * NGTCP2_SECONDS);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_ECN_STATE_FAILED == conn->tx.ecn.state);
+  CU_ASSERT(2 == conn->pktns.tx.ecn.validation_pkt_lost);
+
+  ngtcp2_conn_del(conn);
+
+  /* Prague sends packets with ECT(1) and reacts to CE marking */
+  setup_default_client(&conn);
+
+  ngtcp2_cc_cubic_cc_free(&conn->cc, conn->mem);
+  memset(&conn->cc, 0, sizeof(conn->cc));
+  ngtcp2_cc_prague_cc_init(&conn->cc, &conn->log, /* hystart = */ 1,
+                           /* cwnd_validation = */ 0, conn->mem);
+  conn->cc_algo = NGTCP2_CC_ALGO_PRAGUE;
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, &pi, buf, sizeof(buf), 1);
+
+  CU_ASSERT(0 < spktlen);
+  CU_ASSERT(NGTCP2_ECN_ECT_1 == pi.ecn);
+  CU_ASSERT(0 == conn->pktns.tx.ecn.ect0);
+  CU_ASSERT(1 == conn->pktns.tx.ecn.ect1);
+
+  fr.type = NGTCP2_FRAME_ACK_ECN;
+  fr.ack.largest_ack = 0;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+  fr.ack.ecn.ect0 = 0;
+  fr.ack.ecn.ect1 = 1;
+  fr.ack.ecn.ce = 0;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_ECN_STATE_CAPABLE == conn->tx.ecn.state);
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf), &nwrite,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 1024, 3);
+
+  CU_ASSERT(0 < spktlen);
+  CU_ASSERT(NGTCP2_ECN_ECT_1 == pi.ecn);
+
+  cwnd = conn->cstat.cwnd;
+
+  fr.type = NGTCP2_FRAME_ACK_ECN;
+  fr.ack.largest_ack = 1;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+  fr.ack.ecn.ect0 = 0;
+  fr.ack.ecn.ect1 = 1;
+  fr.ack.ecn.ce = 1;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 4);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_ECN_STATE_CAPABLE == conn->tx.ecn.state);
+  CU_ASSERT(cwnd > conn->cstat.cwnd);
+  CU_ASSERT(conn->cstat.cwnd == conn->cstat.ssthresh);
+  CU_ASSERT(4 == conn->cstat.congestion_recovery_start_ts);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_path_validation(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_ssize spktlen;
+  ngtcp2_tstamp t = 0;
+  int64_t pkt_num = 0;
+  ngtcp2_frame frs[4];
+  int rv;
+  ngtcp2_path_storage rpath, wpath;
+  ngtcp2_pv_entry *ent;
+
+  /* server starts path validation in NAT rebinding scenario. */
+  setup_default_server(&conn);
+
+  /* This will send NEW_CONNECTION_ID frames */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  frs[0].type = NGTCP2_FRAME_PING;
+
+  /* Just change remote port */
+  path_init(&rpath, 0, 0, 0, 1);
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 1,
+                     conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &rpath.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != conn->pv);
+  CU_ASSERT(0 == conn->pv->dcid.seq);
+  CU_ASSERT(ngtcp2_path_eq(&conn->pv->dcid.ps.path, &rpath.path));
+
+  ngtcp2_path_storage_zero(&wpath);
+  spktlen =
+      ngtcp2_conn_write_pkt(conn, &wpath.path, NULL, buf, sizeof(buf), ++t);
+
+  /* Server has not received enough bytes to pad probing packet. */
+  CU_ASSERT(1200 > spktlen);
+  CU_ASSERT(ngtcp2_path_eq(&rpath.path, &wpath.path));
+  CU_ASSERT(1 == ngtcp2_ringbuf_len(&conn->pv->ents.rb));
+
+  ent = ngtcp2_ringbuf_get(&conn->pv->ents.rb, 0);
+
+  CU_ASSERT(ent->flags & NGTCP2_PV_ENTRY_FLAG_UNDERSIZED);
+  CU_ASSERT(conn->pv->flags & NGTCP2_PV_FLAG_FALLBACK_ON_FAILURE);
+  CU_ASSERT(!(conn->pv->flags & NGTCP2_PV_FLAG_MTU_PROBE));
+
+  frs[0].type = NGTCP2_FRAME_PATH_RESPONSE;
+  memcpy(frs[0].path_response.data, ent->data, sizeof(ent->data));
+
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 1,
+                     conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &rpath.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  /* Start another path validation to probe least MTU */
+  CU_ASSERT(NULL != conn->pv);
+  CU_ASSERT(conn->pv->flags & NGTCP2_PV_FLAG_FALLBACK_ON_FAILURE);
+  CU_ASSERT(conn->pv->flags & NGTCP2_PV_FLAG_MTU_PROBE);
+
+  ngtcp2_path_storage_zero(&wpath);
+  spktlen =
+      ngtcp2_conn_write_pkt(conn, &wpath.path, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(1200 <= spktlen);
+  CU_ASSERT(ngtcp2_path_eq(&rpath.path, &wpath.path));
+  CU_ASSERT(1 == ngtcp2_ringbuf_len(&conn->pv->ents.rb));
+
+  ent = ngtcp2_ringbuf_get(&conn->pv->ents.rb, 0);
+  frs[0].type = NGTCP2_FRAME_PATH_RESPONSE;
+  memcpy(frs[0].path_response.data, ent->data, sizeof(ent->data));
+
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 1,
+                     conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &rpath.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  /* Now perform another validation to old path */
+  CU_ASSERT(NULL != conn->pv);
+  CU_ASSERT(!(conn->pv->flags & NGTCP2_PV_FLAG_FALLBACK_ON_FAILURE));
+  CU_ASSERT(!(conn->pv->flags & NGTCP2_PV_FLAG_MTU_PROBE));
+  CU_ASSERT(conn->pv->flags & NGTCP2_PV_FLAG_DONT_CARE);
+
+  ngtcp2_path_storage_zero(&wpath);
+  spktlen =
+      ngtcp2_conn_write_pkt(conn, &wpath.path, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(1200 <= spktlen);
+  CU_ASSERT(ngtcp2_path_eq(&null_path.path, &wpath.path));
+  CU_ASSERT(1 == ngtcp2_ringbuf_len(&conn->pv->ents.rb));
+
+  ngtcp2_conn_del(conn);
+
+  /* server keeps sending at full rate on NAT rebinding if
+     fast_nat_rebinding is enabled. */
+  setup_default_server(&conn);
+  conn->local.settings.fast_nat_rebinding = 1;
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  frs[0].type = NGTCP2_FRAME_PING;
+
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 1,
+                     conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &rpath.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL != conn->pv);
+  CU_ASSERT(ngtcp2_path_eq(&conn->dcid.current.ps.path, &rpath.path));
+  CU_ASSERT(conn->dcid.current.flags & NGTCP2_DCID_FLAG_PATH_VALIDATED);
+
+  ngtcp2_path_storage_zero(&wpath);
+  spktlen =
+      ngtcp2_conn_write_pkt(conn, &wpath.path, NULL, buf, sizeof(buf), ++t);
+
+  /* Probing packet is padded without anti-amplification limit. */
+  CU_ASSERT(1200 <= spktlen);
+  CU_ASSERT(ngtcp2_path_eq(&rpath.path, &wpath.path));
+  CU_ASSERT(1 == ngtcp2_ringbuf_len(&conn->pv->ents.rb));
+
+  ent = ngtcp2_ringbuf_get(&conn->pv->ents.rb, 0);
+
+  CU_ASSERT(!(ent->flags & NGTCP2_PV_ENTRY_FLAG_UNDERSIZED));
+
+  frs[0].type = NGTCP2_FRAME_PATH_RESPONSE;
+  memcpy(frs[0].path_response.data, ent->data, sizeof(ent->data));
+
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 1,
+                     conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &rpath.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  /* No need to probe least MTU; validate old path. */
+  CU_ASSERT(NULL != conn->pv);
+  CU_ASSERT(!(conn->pv->flags & NGTCP2_PV_FLAG_MTU_PROBE));
+  CU_ASSERT(conn->pv->flags & NGTCP2_PV_FLAG_DONT_CARE);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_early_data_sync_stream_data_limit(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[1024];
+  ngtcp2_ssize spktlen;
+  ngtcp2_ssize datalen;
+  int64_t bidi_stream_id, uni_stream_id;
+  int rv;
+  ngtcp2_frame fr;
+  size_t pktlen;
+  ngtcp2_crypto_aead_ctx aead_ctx = {0};
+  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
+  ngtcp2_transport_params params;
+  ngtcp2_strm *strm;
+  ngtcp2_tstamp t = 0;
+
+  setup_early_client(&conn);
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &bidi_stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &datalen, NGTCP2_WRITE_STREAM_FLAG_FIN,
+                                     bidi_stream_id, null_data, 1024, ++t);
+
+  CU_ASSERT((ngtcp2_ssize)sizeof(buf) == spktlen);
+  CU_ASSERT(670 == datalen);
+
+  rv = ngtcp2_conn_open_uni_stream(conn, &uni_stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &datalen, NGTCP2_WRITE_STREAM_FLAG_FIN,
+                                     uni_stream_id, null_data, 1024, ++t);
+
+  CU_ASSERT((ngtcp2_ssize)sizeof(buf) == spktlen);
+  CU_ASSERT(958);
+
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 198;
+  fr.crypto.data[0].base = null_data;
+
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
+      ngtcp2_conn_get_dcid(conn), 0, NGTCP2_PROTO_VER_V1, &fr, &null_ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  rv = ngtcp2_conn_install_rx_handshake_key(conn, &aead_ctx, null_iv,
+                                            sizeof(null_iv), &hp_ctx);
+
+  CU_ASSERT(0 == rv);
+
+  rv = ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
+                                            sizeof(null_iv), &hp_ctx);
+
+  CU_ASSERT(0 == rv);
+
+  rv = ngtcp2_conn_install_rx_key(conn, null_secret, sizeof(null_secret),
+                                  &aead_ctx, null_iv, sizeof(null_iv), &hp_ctx);
+
+  CU_ASSERT(0 == rv);
+
+  memset(&params, 0, sizeof(params));
+  ngtcp2_cid_init(&params.initial_scid, conn->dcid.current.cid.data,
+                  conn->dcid.current.cid.datalen);
+  ngtcp2_cid_init(&params.original_dcid, conn->rcid.data, conn->rcid.datalen);
+  params.max_udp_payload_size = 1200;
+  params.initial_max_stream_data_bidi_local =
+      conn->early.transport_params.initial_max_stream_data_bidi_local;
+  params.initial_max_stream_data_bidi_remote = 640 * 1024;
+  params.initial_max_stream_data_uni = 320 * 1024;
+  params.initial_max_data = conn->early.transport_params.initial_max_data;
+  params.initial_max_streams_bidi =
+      conn->early.transport_params.initial_max_streams_bidi;
+  params.initial_max_streams_uni =
+      conn->early.transport_params.initial_max_streams_uni;
+  params.active_connection_id_limit =
+      conn->early.transport_params.active_connection_id_limit;
+
+  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+
+  CU_ASSERT(0 == rv);
+
+  rv = ngtcp2_conn_install_tx_key(conn, null_secret, sizeof(null_secret),
+                                  &aead_ctx, null_iv, sizeof(null_iv), &hp_ctx);
+
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_conn_handshake_completed(conn);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(0 < spktlen);
+
+  strm = ngtcp2_conn_find_stream(conn, bidi_stream_id);
+
+  CU_ASSERT(params.initial_max_stream_data_bidi_remote == strm->tx.max_offset);
+
+  strm = ngtcp2_conn_find_stream(conn, uni_stream_id);
+
+  CU_ASSERT(params.initial_max_stream_data_uni == strm->tx.max_offset);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_early_data_rejected(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[1024];
+  ngtcp2_ssize spktlen;
+  ngtcp2_ssize datalen;
+  int64_t bidi_stream_id, uni_stream_id;
+  int rv;
+  ngtcp2_frame fr;
+  size_t pktlen;
+  ngtcp2_crypto_aead_ctx aead_ctx = {0};
+  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
+  ngtcp2_transport_params params;
+  ngtcp2_tstamp t = 0;
+
+  setup_early_client(&conn);
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &bidi_stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &datalen, NGTCP2_WRITE_STREAM_FLAG_FIN,
+                                     bidi_stream_id, null_data, 1024, ++t);
+
+  CU_ASSERT((ngtcp2_ssize)sizeof(buf) == spktlen);
+  CU_ASSERT(670 == datalen);
+
+  rv = ngtcp2_conn_open_uni_stream(conn, &uni_stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_conn_extend_max_offset(conn, 1000);
+  ngtcp2_conn_extend_max_streams_bidi(conn, 7);
+  ngtcp2_conn_extend_max_streams_uni(conn, 5);
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &datalen, NGTCP2_WRITE_STREAM_FLAG_FIN,
+                                     uni_stream_id, null_data, 300, ++t);
+
+  CU_ASSERT(0 < spktlen);
+  CU_ASSERT(0 < conn->tx.offset);
+  CU_ASSERT(conn->local.transport_params.initial_max_data + 1000 ==
+            conn->rx.unsent_max_offset);
+  CU_ASSERT(conn->local.transport_params.initial_max_streams_bidi + 7 ==
+            conn->remote.bidi.unsent_max_streams);
+  CU_ASSERT(conn->local.transport_params.initial_max_streams_bidi + 7 ==
+            conn->remote.bidi.max_streams);
+  CU_ASSERT(conn->local.transport_params.initial_max_streams_uni + 5 ==
+            conn->remote.uni.unsent_max_streams);
+  CU_ASSERT(conn->local.transport_params.initial_max_streams_uni + 5 ==
+            conn->remote.uni.max_streams);
+
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 198;
+  fr.crypto.data[0].base = null_data;
+
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
+      ngtcp2_conn_get_dcid(conn), 0, NGTCP2_PROTO_VER_V1, &fr, &null_ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  rv = ngtcp2_conn_install_rx_handshake_key(conn, &aead_ctx, null_iv,
+                                            sizeof(null_iv), &hp_ctx);
+
+  CU_ASSERT(0 == rv);
+
+  rv = ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
+                                            sizeof(null_iv), &hp_ctx);
+
+  CU_ASSERT(0 == rv);
+
+  rv = ngtcp2_conn_install_rx_key(conn, null_secret, sizeof(null_secret),
+                                  &aead_ctx, null_iv, sizeof(null_iv), &hp_ctx);
+
+  CU_ASSERT(0 == rv);
+
+  /* Stream limits in transport parameters can be reduced if early
+     data is rejected. */
+  memset(&params, 0, sizeof(params));
+  ngtcp2_cid_init(&params.initial_scid, conn->dcid.current.cid.data,
+                  conn->dcid.current.cid.datalen);
+  ngtcp2_cid_init(&params.original_dcid, conn->rcid.data, conn->rcid.datalen);
+  params.max_udp_payload_size = 1200;
+  params.initial_max_stream_data_bidi_local =
+      conn->early.transport_params.initial_max_stream_data_bidi_local;
+  params.initial_max_stream_data_bidi_remote =
+      conn->early.transport_params.initial_max_stream_data_bidi_remote / 2;
+  params.initial_max_stream_data_uni = 0;
+  params.initial_max_data = conn->early.transport_params.initial_max_data;
+  params.initial_max_streams_bidi =
+      conn->early.transport_params.initial_max_streams_bidi;
+  params.initial_max_streams_uni =
+      conn->early.transport_params.initial_max_streams_uni;
+  params.active_connection_id_limit =
+      conn->early.transport_params.active_connection_id_limit;
+
+  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+
+  CU_ASSERT(0 == rv);
+
+  rv = ngtcp2_conn_install_tx_key(conn, null_secret, sizeof(null_secret),
+                                  &aead_ctx, null_iv, sizeof(null_iv), &hp_ctx);
+
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_conn_handshake_completed(conn);
+  ngtcp2_conn_early_data_rejected(conn);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(0 < spktlen);
+  CU_ASSERT(NULL == ngtcp2_conn_find_stream(conn, bidi_stream_id));
+  CU_ASSERT(NULL == ngtcp2_conn_find_stream(conn, uni_stream_id));
+  CU_ASSERT(0 == conn->tx.offset);
+  CU_ASSERT(conn->local.transport_params.initial_max_data ==
+            conn->rx.max_offset);
+  CU_ASSERT(conn->local.transport_params.initial_max_data ==
+            conn->rx.unsent_max_offset);
+  CU_ASSERT(conn->local.transport_params.initial_max_streams_bidi ==
+            conn->remote.bidi.max_streams);
+  CU_ASSERT(conn->local.transport_params.initial_max_streams_bidi ==
+            conn->remote.bidi.unsent_max_streams);
+  CU_ASSERT(conn->local.transport_params.initial_max_streams_uni ==
+            conn->remote.uni.max_streams);
+  CU_ASSERT(conn->local.transport_params.initial_max_streams_uni ==
+            conn->remote.uni.unsent_max_streams);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_keep_alive(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  ngtcp2_ssize spktlen;
+  ngtcp2_pkt_info pi;
+  ngtcp2_tstamp t = 0;
+  int rv;
+
+  setup_default_client(&conn);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, &pi, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(0 < spktlen);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, &pi, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(0 == spktlen);
+
+  ngtcp2_conn_set_keep_alive_timeout(conn, 10 * NGTCP2_SECONDS);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, &pi, buf, sizeof(buf), t);
+
+  CU_ASSERT(0 == spktlen);
+
+  t += 10 * NGTCP2_SECONDS;
+
+  rv = ngtcp2_conn_handle_expiry(conn, t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(conn->flags & NGTCP2_CONN_FLAG_KEEP_ALIVE_CANCELLED);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, &pi, buf, sizeof(buf), t);
+
+  CU_ASSERT(0 < spktlen);
+  CU_ASSERT(t == conn->keep_alive.last_ts);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_keep_alive_external(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  ngtcp2_ssize spktlen;
+  ngtcp2_pkt_info pi;
+  ngtcp2_path_storage ps;
+  ngtcp2_tstamp t = 0;
+  size_t num_ack_eliciting;
+
+  setup_default_client(&conn);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, &pi, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(0 < spktlen);
+  CU_ASSERT(UINT64_MAX == ngtcp2_conn_get_keep_alive_expiry(conn));
+
+  ngtcp2_conn_set_keep_alive_timeout(conn, 100 * NGTCP2_MILLISECONDS);
+
+  CU_ASSERT(t + 100 * NGTCP2_MILLISECONDS ==
+            ngtcp2_conn_get_keep_alive_expiry(conn));
+  CU_ASSERT(ngtcp2_conn_get_keep_alive_expiry(conn) ==
+            ngtcp2_conn_get_expiry(conn));
+
+  ngtcp2_conn_set_keep_alive_external(conn, 1);
+
+  CU_ASSERT(ngtcp2_conn_get_keep_alive_expiry(conn) <
+            ngtcp2_conn_get_expiry(conn));
+
+  /* The application may ping before the timer expires. */
+  t += 50 * NGTCP2_MILLISECONDS;
+  num_ack_eliciting = conn->pktns.rtb.num_ack_eliciting;
+  ngtcp2_path_storage_zero(&ps);
+
+  spktlen =
+      ngtcp2_conn_write_keep_alive(conn, &ps.path, &pi, buf, sizeof(buf), t);
+
+  CU_ASSERT(0 < spktlen);
+  CU_ASSERT(ngtcp2_path_eq(&conn->dcid.current.ps.path, &ps.path));
+  CU_ASSERT(num_ack_eliciting + 1 == conn->pktns.rtb.num_ack_eliciting);
+  CU_ASSERT(t + 100 * NGTCP2_MILLISECONDS ==
+            ngtcp2_conn_get_keep_alive_expiry(conn));
+
+  ngtcp2_conn_del(conn);
+
+  /* Keep-alive packet cannot be sent before the handshake
+     completes. */
+  setup_handshake_client(&conn);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_STATE ==
+            ngtcp2_conn_write_keep_alive(conn, NULL, NULL, buf, sizeof(buf),
+                                         ++t));
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_retire_stale_bound_dcid(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_tstamp expiry;
+  int64_t pkt_num = 0;
+  ngtcp2_frame fr;
+  int rv;
+  ngtcp2_cid cid;
+  const uint8_t raw_cid[] = {0x0f, 0x00, 0x00, 0x00};
+  const uint8_t token[NGTCP2_STATELESS_RESET_TOKENLEN] = {0xff};
+  const uint8_t data[] = {0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8};
+
+  ngtcp2_cid_init(&cid, raw_cid, sizeof(raw_cid));
+
+  setup_default_server(&conn);
+
+  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  fr.new_connection_id.seq = 1;
+  fr.new_connection_id.retire_prior_to = 0;
+  fr.new_connection_id.cid = cid;
+  memcpy(fr.new_connection_id.stateless_reset_token, token, sizeof(token));
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  fr.type = NGTCP2_FRAME_PATH_CHALLENGE;
+  memcpy(fr.path_challenge.data, data, sizeof(fr.path_challenge.data));
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(ngtcp2_ringbuf_len(&conn->rx.path_challenge.rb) > 0);
+  CU_ASSERT(ngtcp2_ringbuf_len(&conn->dcid.bound.rb) > 0);
+
+  expiry = ngtcp2_conn_get_expiry(conn);
+
+  CU_ASSERT(UINT64_MAX != expiry);
+
+  t += 3 * ngtcp2_conn_get_pto(conn);
+
+  rv = ngtcp2_conn_handle_expiry(conn, t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.bound.rb));
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_get_scid(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_settings settings;
+  ngtcp2_transport_params params;
+  ngtcp2_cid dcid, scid;
+  ngtcp2_callbacks cb;
+  const uint8_t raw_cid[] = {0x0f, 0x00, 0x00, 0x00};
+  ngtcp2_cid scids[16];
+
+  dcid_init(&dcid);
+  dcid_init(&scid);
+
+  server_default_callbacks(&cb);
+  server_default_settings(&settings);
+
+  /* Without preferred address */
+  server_default_transport_params(&params);
+
+  ngtcp2_conn_server_new(&conn, &dcid, &scid, &null_path.path,
+                         NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
+                         /* mem = */ NULL, NULL);
+
+  CU_ASSERT(1 == ngtcp2_conn_get_num_scid(conn));
+
+  ngtcp2_conn_get_scid(conn, scids);
+
+  CU_ASSERT(ngtcp2_cid_eq(&scid, &scids[0]));
+
+  ngtcp2_conn_del(conn);
+
+  /* With preferred address */
+  server_default_transport_params(&params);
+  params.preferred_address_present = 1;
+  ngtcp2_cid_init(&params.preferred_address.cid, raw_cid, sizeof(raw_cid));
+
+  ngtcp2_conn_server_new(&conn, &dcid, &scid, &null_path.path,
+                         NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
+                         /* mem = */ NULL, NULL);
+
+  CU_ASSERT(2 == ngtcp2_conn_get_num_scid(conn));
+
+  ngtcp2_conn_get_scid(conn, scids);
+
+  CU_ASSERT(ngtcp2_cid_eq(&scid, &scids[0]));
+  CU_ASSERT(ngtcp2_cid_eq(&params.preferred_address.cid, &scids[1]));
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_stream_close(void) {
+  ngtcp2_conn *conn;
+  int rv;
+  uint8_t buf[2048];
+  ngtcp2_frame frs[2];
+  size_t pktlen;
+  int64_t pkt_num = 0;
+  my_user_data ud;
+  ngtcp2_strm *strm;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_ssize spktlen;
+  int64_t stream_id;
+
+  /* Receive RESET_STREAM and STOP_SENDING from client */
+  setup_default_server(&conn);
+  conn->callbacks.stream_close = stream_close;
+  conn->user_data = &ud;
+
+  open_stream(conn, 0);
+
+  frs[0].type = NGTCP2_FRAME_RESET_STREAM;
+  frs[0].reset_stream.stream_id = 0;
+  frs[0].reset_stream.app_error_code = NGTCP2_APP_ERR01;
+  frs[0].reset_stream.final_size = 999;
+
+  frs[1].type = NGTCP2_FRAME_STOP_SENDING;
+  frs[1].stop_sending.stream_id = 0;
+  frs[1].stop_sending.app_error_code = NGTCP2_APP_ERR02;
+
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 2,
+                     conn->pktns.crypto.tx.ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  strm = ngtcp2_conn_find_stream(conn, 0);
+
+  CU_ASSERT(NGTCP2_APP_ERR01 == strm->app_error_code);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT((size_t)spktlen < sizeof(buf));
+
+  frs[0].type = NGTCP2_FRAME_ACK;
+  frs[0].ack.largest_ack = 0;
+  frs[0].ack.ack_delay = 0;
+  frs[0].ack.first_ack_blklen = 0;
+  frs[0].ack.num_blks = 0;
+
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 1,
+                     conn->pktns.crypto.tx.ckm);
+
+  ud.stream_close.flags = NGTCP2_STREAM_CLOSE_FLAG_NONE;
+  ud.stream_close.stream_id = -1;
+  ud.stream_close.app_error_code = 0;
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  CU_ASSERT(NGTCP2_STREAM_CLOSE_FLAG_APP_ERROR_CODE_SET &
+            ud.stream_close.flags);
+  CU_ASSERT(0 == ud.stream_close.stream_id);
+  CU_ASSERT(NGTCP2_APP_ERR01 == ud.stream_close.app_error_code);
+
+  ngtcp2_conn_del(conn);
+
+  /* Client sends STOP_SENDING and then STREAM and fin */
+  pkt_num = 0;
+
+  setup_default_server(&conn);
+  conn->callbacks.stream_close = stream_close;
+  conn->callbacks.recv_stream_data = recv_stream_data;
+  conn->user_data = &ud;
+
+  frs[0].type = NGTCP2_FRAME_STOP_SENDING;
+  frs[0].stop_sending.stream_id = 0;
+  frs[0].stop_sending.app_error_code = NGTCP2_APP_ERR01;
+
+  frs[1].type = NGTCP2_FRAME_STREAM;
+  frs[1].stream.flags = 0;
+  frs[1].stream.fin = 1;
+  frs[1].stream.stream_id = 0;
+  frs[1].stream.offset = 0;
+  frs[1].stream.datacnt = 0;
+
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 2,
+                     conn->pktns.crypto.tx.ckm);
+
+  ud.stream_data.stream_id = -1;
+  ud.stream_data.flags = NGTCP2_STREAM_DATA_FLAG_NONE;
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == ud.stream_data.stream_id);
+  CU_ASSERT((ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN) != 0);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT((size_t)spktlen < sizeof(buf));
+
+  frs[0].type = NGTCP2_FRAME_ACK;
+  frs[0].ack.largest_ack = 0;
+  frs[0].ack.ack_delay = 0;
+  frs[0].ack.first_ack_blklen = 0;
+  frs[0].ack.num_blks = 0;
+
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 1,
+                     conn->pktns.crypto.tx.ckm);
+
+  ud.stream_close.flags = NGTCP2_STREAM_CLOSE_FLAG_NONE;
+  ud.stream_close.stream_id = -1;
+  ud.stream_close.app_error_code = 0;
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  CU_ASSERT(NGTCP2_STREAM_CLOSE_FLAG_APP_ERROR_CODE_SET &
+            ud.stream_close.flags);
+  CU_ASSERT(0 == ud.stream_close.stream_id);
+  CU_ASSERT(NGTCP2_APP_ERR01 == ud.stream_close.app_error_code);
+
+  ngtcp2_conn_del(conn);
+
+  /* Client calls ngtcp2_conn_shutdown_stream, and before sending
+     STOP_SENDING, it receives STREAM with fin bit set. */
+  pkt_num = 0;
+
+  setup_default_client(&conn);
+  conn->callbacks.stream_close = stream_close;
+  conn->user_data = &ud;
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_FIN, stream_id,
+                                     null_data, 1, ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  frs[0].type = NGTCP2_FRAME_ACK;
+  frs[0].ack.largest_ack = conn->pktns.tx.last_pkt_num;
+  frs[0].ack.ack_delay = 0;
+  frs[0].ack.first_ack_blklen = 0;
+  frs[0].ack.num_blks = 0;
+
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 1,
+                     conn->pktns.crypto.tx.ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  rv = ngtcp2_conn_shutdown_stream(conn, stream_id, NGTCP2_APP_ERR01);
+
+  CU_ASSERT(0 == rv);
+
+  frs[0].type = NGTCP2_FRAME_STREAM;
+  frs[0].stream.flags = 0;
+  frs[0].stream.fin = 1;
+  frs[0].stream.stream_id = stream_id;
+  frs[0].stream.offset = 0;
+  frs[0].stream.datacnt = 1;
+  frs[0].stream.data[0].len = 97;
+  frs[0].stream.data[0].base = null_data;
+
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 1,
+                     conn->pktns.crypto.tx.ckm);
+
+  ud.stream_close.flags = NGTCP2_STREAM_CLOSE_FLAG_NONE;
+  ud.stream_close.stream_id = -1;
+  ud.stream_close.app_error_code = 0;
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_STREAM_CLOSE_FLAG_APP_ERROR_CODE_SET &
+            ud.stream_close.flags);
+  CU_ASSERT(stream_id == ud.stream_close.stream_id);
+  CU_ASSERT(NGTCP2_APP_ERR01 == ud.stream_close.app_error_code);
+
+  ngtcp2_conn_del(conn);
+
+  /* Client sends STREAM fin and then RESET_STREAM.  It receives ACK
+     for the STREAM frame, then response fin. No ACK for
+     RESET_STREAM. */
+  pkt_num = 0;
+
+  setup_default_client(&conn);
+  conn->callbacks.stream_close = stream_close;
+  conn->user_data = &ud;
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_FIN, stream_id,
+                                     null_data, 1, ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  rv = ngtcp2_conn_shutdown_stream_write(conn, stream_id, NGTCP2_APP_ERR01);
+
+  CU_ASSERT(0 == rv);
+
+  frs[0].type = NGTCP2_FRAME_STREAM;
+  frs[0].stream.flags = 0;
+  frs[0].stream.fin = 1;
+  frs[0].stream.stream_id = stream_id;
+  frs[0].stream.offset = 0;
+  frs[0].stream.datacnt = 0;
+
+  frs[1].type = NGTCP2_FRAME_ACK;
+  frs[1].ack.largest_ack = conn->pktns.tx.last_pkt_num;
+  frs[1].ack.ack_delay = 0;
+  frs[1].ack.first_ack_blklen = 0;
+  frs[1].ack.num_blks = 0;
+
+  spktlen =
+      ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                               NGTCP2_WRITE_STREAM_FLAG_NONE, -1, NULL, 0, ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 2,
+                     conn->pktns.crypto.tx.ckm);
+
+  ud.stream_close.flags = NGTCP2_STREAM_CLOSE_FLAG_NONE;
+  ud.stream_close.stream_id = -1;
+  ud.stream_close.app_error_code = 0;
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_STREAM_CLOSE_FLAG_APP_ERROR_CODE_SET &
+            ud.stream_close.flags);
+  CU_ASSERT(stream_id == ud.stream_close.stream_id);
+  CU_ASSERT(NGTCP2_APP_ERR01 == ud.stream_close.app_error_code);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_acked_stream_data_offset(void) {
+  ngtcp2_conn *conn;
+  int rv;
+  uint8_t buf[2048];
+  ngtcp2_frame fr;
+  size_t pktlen;
+  int64_t pkt_num = 0;
+  my_user_data ud;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_ssize spktlen;
+  int64_t stream_id_a, stream_id_b;
+  size_t i;
+
+  /* An ACK frame which acknowledges several packets invokes
+     acked_stream_data_offset once per stream. */
+  setup_default_client(&conn);
+  conn->callbacks.acked_stream_data_offset = acked_stream_data_offset;
+  conn->user_data = &ud;
+  conn->local.bidi.max_streams = 2;
+
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id_a, NULL);
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id_b, NULL);
+
+  for (i = 0; i < 3; ++i) {
+    spktlen = ngtcp2_conn_write_stream(
+        conn, NULL, NULL, buf, sizeof(buf), NULL,
+        i == 2 ? NGTCP2_WRITE_STREAM_FLAG_FIN : NGTCP2_WRITE_STREAM_FLAG_NONE,
+        stream_id_a, null_data, 100, ++t);
+
+    CU_ASSERT(spktlen > 0);
+
+    if (i == 0) {
+      spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                         NULL, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                         stream_id_b, null_data, 111, ++t);
+
+      CU_ASSERT(spktlen > 0);
+    }
+  }
+
+  CU_ASSERT(3 == conn->pktns.tx.last_pkt_num);
+
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = 3;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 3;
+  fr.ack.num_blks = 0;
+
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, &fr, 1,
+                     conn->pktns.crypto.tx.ckm);
+
+  memset(&ud, 0, sizeof(ud));
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(2 == ud.acked_stream_data_offset.ncalls);
+
+  for (i = 0; i < 2; ++i) {
+    if (ud.acked_stream_data_offset.calls[i].stream_id == stream_id_a) {
+      CU_ASSERT(0 == ud.acked_stream_data_offset.calls[i].offset);
+      CU_ASSERT(300 == ud.acked_stream_data_offset.calls[i].datalen);
+    } else {
+      CU_ASSERT(stream_id_b == ud.acked_stream_data_offset.calls[i].stream_id);
+      CU_ASSERT(0 == ud.acked_stream_data_offset.calls[i].offset);
+      CU_ASSERT(111 == ud.acked_stream_data_offset.calls[i].datalen);
+    }
+  }
+
+  CU_ASSERT(ngtcp2_conn_find_stream(conn, stream_id_a)->flags &
+            NGTCP2_STRM_FLAG_FIN_ACKED);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_release_stream_buf(void) {
+  ngtcp2_conn *conn;
+  int rv;
+  uint8_t buf[2048];
+  ngtcp2_frame fr;
+  size_t pktlen;
+  int64_t pkt_num = 0;
+  my_user_data ud;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_ssize spktlen;
+  int64_t stream_id;
+  int tags[4];
+  size_t i;
+
+  setup_default_client(&conn);
+  conn->callbacks.release_stream_buf = release_stream_buf;
+  conn->user_data = &ud;
+
+  memset(&ud, 0, sizeof(ud));
+
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  CU_ASSERT(NGTCP2_ERR_STREAM_NOT_FOUND ==
+            ngtcp2_conn_attach_stream_buf(conn, stream_id + 4, 100, NULL));
+
+  for (i = 0; i < 3; ++i) {
+    rv = ngtcp2_conn_attach_stream_buf(conn, stream_id, 100, &tags[i]);
+
+    CU_ASSERT(0 == rv);
+
+    spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                       NULL, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                       stream_id, null_data, 100, ++t);
+
+    CU_ASSERT(spktlen > 0);
+  }
+
+  rv = ngtcp2_conn_attach_stream_buf(conn, stream_id, 50, &tags[3]);
+
+  CU_ASSERT(0 == rv);
+
+  /* The buffer is released as soon as its data are acknowledged even
+     if the preceding data are not. */
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = 1;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, &fr, 1,
+                     conn->pktns.crypto.tx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == ud.release_stream_buf.ncalls);
+  CU_ASSERT(&tags[1] == ud.release_stream_buf.bufs[0]);
+
+  fr.ack.largest_ack = 2;
+  fr.ack.first_ack_blklen = 2;
+
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, &fr, 1,
+                     conn->pktns.crypto.tx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(3 == ud.release_stream_buf.ncalls);
+  CU_ASSERT(&tags[0] == ud.release_stream_buf.bufs[1]);
+  CU_ASSERT(&tags[2] == ud.release_stream_buf.bufs[2]);
+
+  /* The buffer which is not sent is released when conn is deleted. */
+  ngtcp2_conn_del(conn);
+
+  CU_ASSERT(4 == ud.release_stream_buf.ncalls);
+  CU_ASSERT(&tags[3] == ud.release_stream_buf.bufs[3]);
+}
+
+void test_ngtcp2_conn_relay(void) {
+  ngtcp2_conn *down, *up;
+  ngtcp2_relay *relay;
+  my_user_data down_ud, up_ud;
+  ngtcp2_relay_callbacks callbacks;
+  uint8_t rxbuf[1024], rxbuf2[1024], buf[2048];
+  ngtcp2_frame fr;
+  size_t pktlen;
+  int64_t down_pkt_num = 0, up_pkt_num = 0;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_ssize spktlen, ndatalen;
+  ngtcp2_vec datav[4];
+  size_t datavcnt;
+  int64_t up_stream_id;
+  ngtcp2_strm *strm;
+  uint64_t max_stream_offset, max_offset;
+  int fin;
+  int rv;
+
+  setup_default_server(&down);
+  down->callbacks.recv_stream_data = recv_stream_data_relay;
+  down->user_data = &down_ud;
+  down->local.settings.decrypt_in_place = 1;
+
+  setup_default_client(&up);
+  up->callbacks.release_stream_buf = release_stream_buf_relay;
+  up->user_data = &up_ud;
+
+  ngtcp2_conn_open_bidi_stream(up, &up_stream_id, NULL);
+
+  callbacks.ref_rxbuf = relay_ref_rxbuf;
+  callbacks.unref_rxbuf = relay_unref_rxbuf;
+
+  rv = ngtcp2_relay_new(&relay, down, 4, up, up_stream_id, &callbacks,
+                        &down_ud, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  memset(&down_ud, 0, sizeof(down_ud));
+  memset(&up_ud, 0, sizeof(up_ud));
+  down_ud.relay.relay = relay;
+  up_ud.relay.relay = relay;
+
+  /* The data decrypted in place is forwarded without copying. */
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.flags = 0;
+  fr.stream.stream_id = 4;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 111;
+  fr.stream.data[0].base = null_data;
+
+  pktlen = write_single_frame_pkt(rxbuf, sizeof(rxbuf), &down->oscid,
+                                  ++down_pkt_num, &fr,
+                                  down->pktns.crypto.rx.ckm);
+
+  down_ud.relay.rxbuf = rxbuf;
+  rv = ngtcp2_conn_read_pkt(down, &null_path.path, &null_pi, rxbuf, pktlen,
+                            ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == down_ud.relay.nref);
+
+  /* The other data is copied. */
+  down->local.settings.decrypt_in_place = 0;
+
+  fr.stream.fin = 1;
+  fr.stream.offset = 111;
+  fr.stream.data[0].len = 99;
+
+  pktlen = write_single_frame_pkt(rxbuf2, sizeof(rxbuf2), &down->oscid,
+                                  ++down_pkt_num, &fr,
+                                  down->pktns.crypto.rx.ckm);
+
+  down_ud.relay.rxbuf = rxbuf2;
+  rv = ngtcp2_conn_read_pkt(down, &null_path.path, &null_pi, rxbuf2, pktlen,
+                            ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == down_ud.relay.nref);
+
+  datavcnt = ngtcp2_relay_get_stream_data(relay, datav, 4, &fin);
+
+  CU_ASSERT(2 == datavcnt);
+  CU_ASSERT(fin);
+  CU_ASSERT(datav[0].base > rxbuf);
+  CU_ASSERT(datav[0].base + datav[0].len <= rxbuf + sizeof(rxbuf));
+  CU_ASSERT(111 == datav[0].len);
+  CU_ASSERT(99 == datav[1].len);
+
+  spktlen = ngtcp2_conn_writev_stream(up, NULL, NULL, buf, sizeof(buf),
+                                      &ndatalen, NGTCP2_WRITE_STREAM_FLAG_FIN,
+                                      up_stream_id, datav, datavcnt, ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(210 == ndatalen);
+
+  ngtcp2_relay_add_write_offset(relay, (uint64_t)ndatalen);
+
+  CU_ASSERT(0 == ngtcp2_relay_get_stream_data(relay, datav, 4, &fin));
+  CU_ASSERT(!fin);
+
+  /* The downstream windows are not extended until the upstream
+     acknowledges the data. */
+  strm = ngtcp2_conn_find_stream(down, 4);
+  max_stream_offset = strm->rx.unsent_max_offset;
+  max_offset = down->rx.unsent_max_offset;
+
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = up->pktns.tx.last_pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+
+  pktlen = write_pkt(buf, sizeof(buf), &up->oscid, ++up_pkt_num, &fr, 1,
+                     up->pktns.crypto.tx.ckm);
+  rv = ngtcp2_conn_read_pkt(up, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == down_ud.relay.nref);
+  CU_ASSERT(max_stream_offset + 210 == strm->rx.unsent_max_offset);
+  CU_ASSERT(max_offset + 210 == down->rx.unsent_max_offset);
+
+  ngtcp2_relay_del(relay);
+  ngtcp2_conn_del(up);
+  ngtcp2_conn_del(down);
+}
+
+/*
+ * send_stream_sendbuf sends the buffered data of a stream denoted by
+ * |stream_id| as long as congestion control permits, and then
+ * acknowledges all packets sent so far.  It returns the number of
+ * stream bytes sent.
+ */
+static size_t send_stream_sendbuf(ngtcp2_conn *conn, int64_t stream_id,
+                                  int64_t *ppkt_num, ngtcp2_tstamp *pt) {
+  uint8_t buf[2048];
+  ngtcp2_frame fr;
+  ngtcp2_ssize spktlen, ndatalen;
+  size_t pktlen, total = 0;
+  int rv;
+
+  for (;;) {
+    spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                       &ndatalen, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                       stream_id, NULL, 0, ++*pt);
+    if (spktlen == NGTCP2_ERR_STREAM_SHUT_WR) {
+      break;
+    }
+
+    CU_ASSERT(spktlen >= 0);
+
+    if (spktlen <= 0 || ndatalen < 0) {
+      break;
+    }
+
+    total += (size_t)ndatalen;
+  }
+
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = (uint64_t)conn->pktns.tx.last_pkt_num;
+  fr.ack.num_blks = 0;
+
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++*ppkt_num, &fr, 1,
+                     conn->pktns.crypto.tx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen,
+                            ++*pt);
+
+  CU_ASSERT(0 == rv);
+
+  return total;
+}
+
+void test_ngtcp2_conn_stream_sendbuf(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_strm *strm;
+  int rv;
+  int64_t pkt_num = 0;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_ssize nwrite;
+  int64_t stream_id;
+  size_t i, nsent;
+  uint8_t buf[2048];
+
+  setup_default_client(&conn);
+
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT ==
+            ngtcp2_conn_set_stream_sendbuf(conn, stream_id, 0));
+  CU_ASSERT(NGTCP2_ERR_STREAM_NOT_FOUND ==
+            ngtcp2_conn_set_stream_sendbuf(conn, stream_id + 4, 20000));
+  CU_ASSERT(NGTCP2_ERR_INVALID_STATE ==
+            ngtcp2_conn_buffer_stream_data(conn, stream_id,
+                                           NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                           null_data, sizeof(null_data)));
+
+  rv = ngtcp2_conn_set_stream_sendbuf(conn, stream_id, 20000);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_ERR_INVALID_STATE ==
+            ngtcp2_conn_set_stream_sendbuf(conn, stream_id, 20000));
+
+  /* The data beyond the buffer size are not taken. */
+  for (i = 0, nsent = 0; i < 5; ++i) {
+    nwrite = ngtcp2_conn_buffer_stream_data(conn, stream_id,
+                                            NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                            null_data, sizeof(null_data));
+
+    CU_ASSERT(nwrite >= 0);
+
+    nsent += (size_t)nwrite;
+  }
+
+  CU_ASSERT(20000 == nsent);
+  CU_ASSERT(0 == ngtcp2_conn_buffer_stream_data(
+                     conn, stream_id, NGTCP2_WRITE_STREAM_FLAG_NONE, null_data,
+                     sizeof(null_data)));
+
+  /* The application must not pass the data to the buffered stream. */
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT ==
+            ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 100, ++t));
+
+  for (nsent = 0; strm->tx.offset < 20000;) {
+    nsent += send_stream_sendbuf(conn, stream_id, &pkt_num, &t);
+  }
+
+  CU_ASSERT(20000 == nsent);
+  CU_ASSERT(20000 == ngtcp2_strm_get_acked_offset(strm));
+
+  /* The first chunk is released and kept to be reused.  The last
+     chunk is kept because it is not filled up. */
+  CU_ASSERT(NGTCP2_STRM_SENDBUF_CHUNKLEN == strm->tx.sendbuf->offset);
+  CU_ASSERT(NULL != strm->tx.sendbuf->spare);
+  CU_ASSERT(strm->tx.sendbuf->head == strm->tx.sendbuf->tail);
+
+  /* The space of the released chunk is available again. */
+  for (i = 0, nsent = 0; i < 4; ++i) {
+    nwrite = ngtcp2_conn_buffer_stream_data(conn, stream_id,
+                                            NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                            null_data, sizeof(null_data));
+
+    CU_ASSERT(nwrite >= 0);
+
+    nsent += (size_t)nwrite;
+  }
+
+  CU_ASSERT(NGTCP2_STRM_SENDBUF_CHUNKLEN == nsent);
+
+  nwrite = ngtcp2_conn_buffer_stream_data(
+      conn, stream_id, NGTCP2_WRITE_STREAM_FLAG_FIN, NULL, 0);
+
+  CU_ASSERT(0 == nwrite);
+  CU_ASSERT(strm->tx.sendbuf->fin);
+  CU_ASSERT(NULL == strm->tx.sendbuf->spare);
+  CU_ASSERT(NGTCP2_ERR_INVALID_STATE ==
+            ngtcp2_conn_buffer_stream_data(conn, stream_id,
+                                           NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                           null_data, 100));
+
+  for (nsent = 0; !(strm->flags & NGTCP2_STRM_FLAG_SHUT_WR);) {
+    nsent += send_stream_sendbuf(conn, stream_id, &pkt_num, &t);
+  }
+
+  CU_ASSERT(NGTCP2_STRM_SENDBUF_CHUNKLEN == nsent);
+  CU_ASSERT(NULL == strm->tx.sendbuf->head);
+  CU_ASSERT(strm->flags & NGTCP2_STRM_FLAG_SHUT_WR);
+  CU_ASSERT(NGTCP2_ERR_STREAM_SHUT_WR ==
+            ngtcp2_conn_buffer_stream_data(conn, stream_id,
+                                           NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                           null_data, 100));
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_stream_sched(void) {
+  ngtcp2_conn *conn;
+  int rv;
+  uint8_t buf[2048];
+  ngtcp2_tstamp t = 0;
+  ngtcp2_ssize spktlen;
+  int64_t stream_id[3];
+  ngtcp2_stream_priority pri;
+  size_t i;
+
+  /* Round robin */
+  setup_default_client(&conn);
+  conn->local.bidi.max_streams = 3;
+
+  CU_ASSERT(-1 == ngtcp2_conn_get_scheduled_stream(conn));
+  CU_ASSERT(NGTCP2_ERR_STREAM_NOT_FOUND ==
+            ngtcp2_conn_schedule_stream(conn, 0));
+
+  for (i = 0; i < 3; ++i) {
+    ngtcp2_conn_open_bidi_stream(conn, &stream_id[i], NULL);
+
+    rv = ngtcp2_conn_schedule_stream(conn, stream_id[i]);
+
+    CU_ASSERT(0 == rv);
+  }
+
+  for (i = 0; i < 6; ++i) {
+    CU_ASSERT(stream_id[i % 3] == ngtcp2_conn_get_scheduled_stream(conn));
+
+    spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                       NULL, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                       stream_id[i % 3], null_data, 100, ++t);
+
+    CU_ASSERT(spktlen > 0);
+  }
+
+  ngtcp2_conn_unschedule_stream(conn, stream_id[0]);
+
+  CU_ASSERT(stream_id[1] == ngtcp2_conn_get_scheduled_stream(conn));
+
+  rv = ngtcp2_conn_shutdown_stream_write(conn, stream_id[1], NGTCP2_APP_ERR01);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(stream_id[2] == ngtcp2_conn_get_scheduled_stream(conn));
+  CU_ASSERT(NGTCP2_ERR_STREAM_SHUT_WR ==
+            ngtcp2_conn_schedule_stream(conn, stream_id[1]));
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_FIN,
+                                     stream_id[2], null_data, 100, ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(-1 == ngtcp2_conn_get_scheduled_stream(conn));
+
+  ngtcp2_conn_del(conn);
+
+  /* Strict priority */
+  setup_default_client(&conn);
+  conn->local.bidi.max_streams = 3;
+  ngtcp2_sched_free(&conn->tx.sched);
+  ngtcp2_sched_init(&conn->tx.sched, NGTCP2_SCHED_POLICY_STRICT_PRIORITY,
+                    conn->mem);
+
+  for (i = 0; i < 3; ++i) {
+    ngtcp2_conn_open_bidi_stream(conn, &stream_id[i], NULL);
+  }
+
+  pri.urgency = NGTCP2_URGENCY_LEVELS;
+  pri.incremental = 0;
+  pri.weight = NGTCP2_DEFAULT_STREAM_WEIGHT;
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT ==
+            ngtcp2_conn_set_stream_priority(conn, stream_id[0], &pri));
+
+  pri.urgency = 1;
+  pri.incremental = 1;
+
+  for (i = 1; i < 3; ++i) {
+    rv = ngtcp2_conn_set_stream_priority(conn, stream_id[i], &pri);
+
+    CU_ASSERT(0 == rv);
+  }
+
+  for (i = 0; i < 3; ++i) {
+    rv = ngtcp2_conn_schedule_stream(conn, stream_id[i]);
+
+    CU_ASSERT(0 == rv);
+  }
+
+  /* The incremental streams of urgency 1 take turns before the stream
+     of the default urgency. */
+  for (i = 0; i < 4; ++i) {
+    CU_ASSERT(stream_id[1 + i % 2] == ngtcp2_conn_get_scheduled_stream(conn));
+
+    spktlen = ngtcp2_conn_write_stream(
+        conn, NULL, NULL, buf, sizeof(buf), NULL, NGTCP2_WRITE_STREAM_FLAG_NONE,
+        stream_id[1 + i % 2], null_data, 100, ++t);
+
+    CU_ASSERT(spktlen > 0);
+  }
+
+  /* Non-incremental stream keeps its position until it finishes. */
+  pri.urgency = 0;
+  pri.incremental = 0;
+
+  rv = ngtcp2_conn_set_stream_priority(conn, stream_id[0], &pri);
+
+  CU_ASSERT(0 == rv);
+
+  for (i = 0; i < 2; ++i) {
+    CU_ASSERT(stream_id[0] == ngtcp2_conn_get_scheduled_stream(conn));
+
+    spktlen = ngtcp2_conn_write_stream(
+        conn, NULL, NULL, buf, sizeof(buf), NULL,
+        i == 1 ? NGTCP2_WRITE_STREAM_FLAG_FIN : NGTCP2_WRITE_STREAM_FLAG_NONE,
+        stream_id[0], null_data, 100, ++t);
+
+    CU_ASSERT(spktlen > 0);
+  }
+
+  CU_ASSERT(stream_id[1] == ngtcp2_conn_get_scheduled_stream(conn));
+
+  ngtcp2_conn_del(conn);
+
+  /* Weighted fair */
+  setup_default_client(&conn);
+  conn->local.bidi.max_streams = 3;
+  ngtcp2_sched_free(&conn->tx.sched);
+  ngtcp2_sched_init(&conn->tx.sched, NGTCP2_SCHED_POLICY_WEIGHTED_FAIR,
+                    conn->mem);
+
+  for (i = 0; i < 2; ++i) {
+    ngtcp2_conn_open_bidi_stream(conn, &stream_id[i], NULL);
+  }
+
+  pri.urgency = NGTCP2_DEFAULT_URGENCY;
+  pri.incremental = 0;
+  pri.weight = NGTCP2_MAX_STREAM_WEIGHT / 4;
+
+  rv = ngtcp2_conn_set_stream_priority(conn, stream_id[0], &pri);
+
+  CU_ASSERT(0 == rv);
+
+  pri.weight = NGTCP2_MAX_STREAM_WEIGHT;
+
+  rv = ngtcp2_conn_set_stream_priority(conn, stream_id[1], &pri);
+
+  CU_ASSERT(0 == rv);
+
+  for (i = 0; i < 2; ++i) {
+    rv = ngtcp2_conn_schedule_stream(conn, stream_id[i]);
+
+    CU_ASSERT(0 == rv);
+  }
+
+  /* Stream 1 sends 4 times as much data as stream 0. */
+  for (i = 0; i < 10; ++i) {
+    CU_ASSERT(stream_id[i % 5 == 0 ? 0 : 1] ==
+              ngtcp2_conn_get_scheduled_stream(conn));
+
+    spktlen = ngtcp2_conn_write_stream(
+        conn, NULL, NULL, buf, sizeof(buf), NULL, NGTCP2_WRITE_STREAM_FLAG_NONE,
+        ngtcp2_conn_get_scheduled_stream(conn), null_data, 100, ++t);
+
+    CU_ASSERT(spktlen > 0);
+  }
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_writev_streams(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[8192];
+  ngtcp2_tstamp t = 0;
+  ngtcp2_ssize spktlen;
+  int64_t stream_id;
+  ngtcp2_stream_write sw[4];
+  ngtcp2_vec datav[3];
+  ngtcp2_strm *strm;
+  size_t gsolen;
+  size_t i;
+
+  /* Many small streams are packed into a single packet. */
+  setup_default_client(&conn);
+  conn->local.bidi.max_streams = 3;
+
+  for (i = 0; i < 3; ++i) {
+    ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+    datav[i].base = null_data;
+    datav[i].len = 10;
+
+    sw[i].stream_id = stream_id;
+    sw[i].flags = NGTCP2_WRITE_STREAM_FLAG_FIN;
+    sw[i].datav = &datav[i];
+    sw[i].datavcnt = 1;
+  }
+
+  /* A stream which does not exist is skipped. */
+  sw[3].stream_id = stream_id + 4;
+  sw[3].flags = NGTCP2_WRITE_STREAM_FLAG_NONE;
+  sw[3].datav = &datav[0];
+  sw[3].datavcnt = 1;
+
+  spktlen = ngtcp2_conn_writev_streams(conn, NULL, NULL, buf, sizeof(buf),
+                                       &gsolen, sw, 4, ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT((size_t)spktlen == gsolen);
+
+  for (i = 0; i < 3; ++i) {
+    CU_ASSERT(10 == sw[i].ndatalen);
+
+    strm = ngtcp2_conn_find_stream(conn, sw[i].stream_id);
+
+    CU_ASSERT(strm->flags & NGTCP2_STRM_FLAG_SHUT_WR);
+  }
+
+  CU_ASSERT(0 == sw[3].ndatalen);
+
+  ngtcp2_conn_del(conn);
+
+  /* The data of a stream spans multiple packets of the same length
+     except for the last one. */
+  setup_default_client(&conn);
+  /* Packets are written one by one during ECN validation. */
+  conn->tx.ecn.state = NGTCP2_ECN_STATE_CAPABLE;
+
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  datav[0].base = null_data;
+  datav[0].len = 1000;
+  datav[1].base = null_data;
+  datav[1].len = 1000;
+  datav[2].base = null_data;
+  datav[2].len = 1000;
+
+  sw[0].stream_id = stream_id;
+  sw[0].flags = NGTCP2_WRITE_STREAM_FLAG_FIN;
+  sw[0].datav = datav;
+  sw[0].datavcnt = 3;
+
+  spktlen = ngtcp2_conn_writev_streams(conn, NULL, NULL, buf, sizeof(buf),
+                                       &gsolen, sw, 1, ++t);
+
+  CU_ASSERT(3000 == sw[0].ndatalen);
+  CU_ASSERT(gsolen > 0);
+  CU_ASSERT((size_t)spktlen > gsolen);
+  CU_ASSERT((size_t)spktlen <= 2 * gsolen);
+  CU_ASSERT(conn->tx.offset == 3000);
+
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
+
+  CU_ASSERT(strm->flags & NGTCP2_STRM_FLAG_SHUT_WR);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_write_burst(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[8192];
+  ngtcp2_tstamp t = 0;
+  ngtcp2_ssize spktlen;
+  int64_t stream_id;
+  ngtcp2_stream_write sw;
+  ngtcp2_vec datav;
+  size_t gsolen;
+  uint8_t data[5000];
+
+  memset(data, 0, sizeof(data));
+
+  /* The number of packets is limited by max_pkts. */
+  setup_default_client(&conn);
+  conn->tx.ecn.state = NGTCP2_ECN_STATE_CAPABLE;
+
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  datav.base = data;
+  datav.len = sizeof(data);
+
+  sw.stream_id = stream_id;
+  sw.flags = NGTCP2_WRITE_STREAM_FLAG_FIN;
+  sw.datav = &datav;
+  sw.datavcnt = 1;
+
+  spktlen = ngtcp2_conn_write_burst(conn, NULL, NULL, buf, sizeof(buf), 2,
+                                    &gsolen, &sw, 1, ++t);
+
+  CU_ASSERT(ngtcp2_conn_get_path_max_udp_payload_size(conn) == gsolen);
+  CU_ASSERT((size_t)spktlen == 2 * gsolen);
+  CU_ASSERT(sw.ndatalen < 5000);
+  CU_ASSERT(conn->tx.offset == sw.ndatalen);
+
+  ngtcp2_conn_del(conn);
+
+  /* The packet which carries the tail of stream data is padded to
+     the segment size. */
+  setup_default_client(&conn);
+  conn->tx.ecn.state = NGTCP2_ECN_STATE_CAPABLE;
+
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  sw.stream_id = stream_id;
+
+  spktlen = ngtcp2_conn_write_burst(conn, NULL, NULL, buf, sizeof(buf), 0,
+                                    &gsolen, &sw, 1, ++t);
+
+  CU_ASSERT(ngtcp2_conn_get_path_max_udp_payload_size(conn) == gsolen);
+  CU_ASSERT(0 == (size_t)spktlen % gsolen);
+  CU_ASSERT(5000 == sw.ndatalen);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_pkt_tx_time(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[1200];
+  ngtcp2_tstamp t = 1000 * NGTCP2_MILLISECONDS;
+  ngtcp2_ssize spktlen;
+  ngtcp2_ssize nwrite;
+  int64_t stream_id;
+  ngtcp2_pkt_info pi;
+
+  /* Without pacing, the departure time is the current time. */
+  setup_default_client(&conn);
+
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  memset(&pi, 0, sizeof(pi));
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 1000, t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(t == pi.tx_ts);
+
+  ngtcp2_conn_del(conn);
+
+  /* Packets written in a batch are spread out at the pacing rate. */
+  setup_default_client(&conn);
+  conn->cstat.pacing_rate = 0.5;
+
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 1000, t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(t == pi.tx_ts);
+
+  nwrite = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf), NULL,
+                                    NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                    null_data, 1000, t);
+
+  CU_ASSERT(nwrite > 0);
+  CU_ASSERT(t + (ngtcp2_tstamp)spktlen * 2 == pi.tx_ts);
+
+  /* The next batch departs after the previous one. */
+  ngtcp2_conn_update_pkt_tx_time(conn, t);
+
+  CU_ASSERT(t + (ngtcp2_tstamp)(spktlen + nwrite) * 2 ==
+            conn->tx.pacing.departure_ts);
+
+  t += (ngtcp2_tstamp)(spktlen + nwrite) * 2;
+
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 1000, t - 1);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(t == pi.tx_ts);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_ack_frame_cache(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  size_t pktlen;
+  ngtcp2_ssize spktlen;
+  ngtcp2_frame fr;
+  ngtcp2_tstamp t = 1000 * NGTCP2_MILLISECONDS;
+  ngtcp2_pktns *pktns;
+  ngtcp2_ack *ack;
+  uint64_t gen;
+  int rv;
+
+  setup_default_client(&conn);
+
+  pktns = &conn->pktns;
+
+  fr.type = NGTCP2_FRAME_PING;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, t);
+
+  CU_ASSERT(0 == rv);
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 4, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, t);
+
+  CU_ASSERT(0 == rv);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), t);
+
+  CU_ASSERT(spktlen > 0);
+
+  ack = &pktns->tx.ack.fr->ack;
+  gen = pktns->acktr.gen;
+
+  CU_ASSERT(gen == pktns->tx.ack.acktr_gen);
+  CU_ASSERT(4 == ack->largest_ack);
+  CU_ASSERT(0 == ack->first_ack_blklen);
+  CU_ASSERT(1 == ack->num_blks);
+  CU_ASSERT(1 == ack->blks[0].gap);
+  CU_ASSERT(0 == ack->blks[0].blklen);
+
+  /* Extending the largest range keeps the other ACK blocks. */
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 5, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(gen == pktns->acktr.gen);
+
+  t += 100 * NGTCP2_MILLISECONDS;
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), t);
+
+  CU_ASSERT(spktlen > 0);
+
+  ack = &pktns->tx.ack.fr->ack;
+
+  CU_ASSERT(gen == pktns->tx.ack.acktr_gen);
+  CU_ASSERT(5 == ack->largest_ack);
+  CU_ASSERT(1 == ack->first_ack_blklen);
+  CU_ASSERT(1 == ack->num_blks);
+  CU_ASSERT(1 == ack->blks[0].gap);
+  CU_ASSERT(0 == ack->blks[0].blklen);
+  CU_ASSERT(100 * NGTCP2_MILLISECONDS == ack->ack_delay_unscaled);
+
+  /* Filling a gap rebuilds ACK blocks. */
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(gen != pktns->acktr.gen);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), t);
+
+  CU_ASSERT(spktlen > 0);
+
+  ack = &pktns->tx.ack.fr->ack;
+
+  CU_ASSERT(pktns->acktr.gen == pktns->tx.ack.acktr_gen);
+  CU_ASSERT(5 == ack->largest_ack);
+  CU_ASSERT(1 == ack->first_ack_blklen);
+  CU_ASSERT(1 == ack->num_blks);
+  CU_ASSERT(0 == ack->blks[0].gap);
+  CU_ASSERT(1 == ack->blks[0].blklen);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_buffer_pkt(void) {
+  ngtcp2_conn *conn;
+  int rv;
+  uint8_t buf[2048];
+  ngtcp2_frame fr;
+  ngtcp2_frame frs[2];
+  size_t pktlen, in_pktlen;
+  int64_t pkt_num = 0;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_ssize spktlen;
+  ngtcp2_crypto_aead_ctx aead_ctx = {0};
+  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
+  ngtcp2_pkt_chain *pc;
+  size_t i;
+
+  /* Server should buffer Short packet if it does not complete
+     handshake even if it has application tx key. */
+  setup_handshake_server(&conn);
+
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 1193;
+  fr.crypto.data[0].base = null_data;
+
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
+      ngtcp2_conn_get_dcid(conn), pkt_num++, NGTCP2_PROTO_VER_V1, &fr,
+      &null_ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  rv = ngtcp2_conn_install_tx_key(conn, null_secret, sizeof(null_secret),
+                                  &aead_ctx, null_iv, sizeof(null_iv), &hp_ctx);
+
+  assert(0 == rv);
+
+  rv = ngtcp2_conn_install_rx_key(conn, null_secret, sizeof(null_secret),
+                                  &aead_ctx, null_iv, sizeof(null_iv), &hp_ctx);
+
+  assert(0 == rv);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  fr.type = NGTCP2_FRAME_PING;
+
+  in_pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
+      ngtcp2_conn_get_dcid(conn), pkt_num++, NGTCP2_PROTO_VER_V1, &fr,
+      &null_ckm);
+
+  frs[0].type = NGTCP2_FRAME_PING;
+  frs[1].type = NGTCP2_FRAME_PADDING;
+  frs[1].padding.len = 1200;
+
+  pktlen = write_pkt(buf + in_pktlen, sizeof(buf) - in_pktlen, &conn->oscid,
+                     pkt_num++, frs, 2, &null_ckm);
+
+  CU_ASSERT(!conn->pktns.rx.buffed_pkts);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
+                            in_pktlen + pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+
+  pc = conn->pktns.rx.buffed_pkts;
+
+  CU_ASSERT(pktlen == pc->pktlen);
+  CU_ASSERT(in_pktlen + pktlen == pc->dgramlen);
+  CU_ASSERT(1 == conn->cstat.undecryptable_pkt_buffered_count);
+
+  CU_ASSERT(ngtcp2_acktr_empty(&conn->pktns.acktr));
+
+  /* Packets which do not fit in the buffer are dropped. */
+  for (i = 0; i < 8; ++i) {
+    pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, pkt_num++, frs, 2,
+                       &null_ckm);
+    rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen,
+                              ++t);
+
+    CU_ASSERT(0 == rv);
+  }
+
+  CU_ASSERT(conn->cstat.undecryptable_pkt_dropped_count > 0);
+  CU_ASSERT(9 == conn->cstat.undecryptable_pkt_buffered_count +
+                     conn->cstat.undecryptable_pkt_dropped_count);
+
+  for (i = 0, pc = conn->pktns.rx.buffed_pkts; pc; pc = pc->next, ++i)
+    ;
+
+  CU_ASSERT(conn->cstat.undecryptable_pkt_buffered_count == i);
+  CU_ASSERT(ngtcp2_buf_len(&conn->pktns.rx.buffed_pkts_buf) <=
+            NGTCP2_BUFFED_RX_PKTS_BUFLEN);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_handshake_timeout(void) {
+  ngtcp2_conn *conn;
+  int rv;
+
+  /* handshake has just timed out */
+  setup_handshake_server(&conn);
+
+  rv = ngtcp2_conn_handle_expiry(conn,
+                                 conn->local.settings.initial_ts +
+                                     conn->local.settings.handshake_timeout);
+
+  CU_ASSERT(NGTCP2_ERR_HANDSHAKE_TIMEOUT == rv);
+
+  ngtcp2_conn_del(conn);
+
+  /* handshake is still in progress */
+  setup_handshake_server(&conn);
+
+  rv = ngtcp2_conn_handle_expiry(
+      conn, conn->local.settings.initial_ts +
+                conn->local.settings.handshake_timeout - 1);
+
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_conn_del(conn);
+
+  /* handshake timeout should be ignored after handshake has
+     completed. */
+  setup_default_server(&conn);
+
+  rv = ngtcp2_conn_handle_expiry(conn,
+                                 conn->local.settings.initial_ts +
+                                     conn->local.settings.handshake_timeout);
+
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_get_connection_close_error(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  ngtcp2_frame frs[2];
+  size_t pktlen;
+  uint8_t reason[2048];
+  ngtcp2_tstamp t = 0;
+  int64_t pkt_num = 0;
+  int rv;
+  ngtcp2_connection_close_error ccerr;
+
+  memset(reason, 'a', sizeof(reason));
+
+  setup_default_server(&conn);
+
+  /* Record the last error. */
+  frs[0].type = NGTCP2_FRAME_CONNECTION_CLOSE_APP;
+  frs[0].connection_close.error_code = 1;
+  frs[0].connection_close.frame_type = 99;
+  frs[0].connection_close.reasonlen = 10;
+  frs[0].connection_close.reason = reason;
+
+  frs[1].type = NGTCP2_FRAME_CONNECTION_CLOSE;
+  frs[1].connection_close.error_code = NGTCP2_PROTOCOL_VIOLATION;
+  frs[1].connection_close.frame_type = 1000000007;
+  frs[1].connection_close.reasonlen =
+      NGTCP2_CONNECTION_CLOSE_ERROR_MAX_REASONLEN + 1;
+  frs[1].connection_close.reason = reason;
+
+  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs,
+                     arraylen(frs), conn->pktns.crypto.rx.ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(NGTCP2_ERR_DRAINING == rv);
+
+  ngtcp2_conn_get_connection_close_error(conn, &ccerr);
+
+  CU_ASSERT(NGTCP2_PROTOCOL_VIOLATION == ccerr.error_code);
+  CU_ASSERT(NGTCP2_CONNECTION_CLOSE_ERROR_CODE_TYPE_TRANSPORT == ccerr.type);
+  CU_ASSERT(1000000007 == ccerr.frame_type);
+  CU_ASSERT(0 == memcmp(reason, ccerr.reason, ccerr.reasonlen));
+  CU_ASSERT(NGTCP2_CONNECTION_CLOSE_ERROR_MAX_REASONLEN == ccerr.reasonlen);
+
+  ngtcp2_conn_del(conn);
+}
+
+void test_ngtcp2_conn_version_negotiation(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  ngtcp2_frame fr;
+  ngtcp2_tstamp t = 0;
+  ngtcp2_ssize spktlen;
+  int64_t pkt_num = 0;
+  size_t pktlen;
+  int rv;
+  ngtcp2_transport_params remote_params;
+  uint8_t other_versions[sizeof(uint32_t) * 2];
+
+  ngtcp2_put_uint32be(&other_versions[0], NGTCP2_PROTO_VER_V1);
+  ngtcp2_put_uint32be(&other_versions[4], NGTCP2_PROTO_VER_V2_DRAFT);
+
+  /* Client sees the change version in Initial packet which contains
+     CRYPTO frame.  It generates new Initial keys and sets negotiated
+     version. */
+  setup_handshake_client(&conn);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 133;
+  fr.crypto.data[0].base = null_data;
+
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
+      ngtcp2_conn_get_dcid(conn), pkt_num++, NGTCP2_PROTO_VER_V2_DRAFT, &fr,
+      &null_ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_PROTO_VER_V2_DRAFT == conn->negotiated_version);
+  CU_ASSERT(NGTCP2_PROTO_VER_V2_DRAFT == conn->vneg.version);
+  CU_ASSERT(conn->vneg.rx.ckm != NULL);
+  CU_ASSERT(conn->vneg.tx.ckm != NULL);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(NGTCP2_PROTO_VER_V2_DRAFT == ngtcp2_get_uint32(&buf[1]));
+
+  ngtcp2_conn_del(conn);
+
+  /* Client receives Initial packet which does not change version and
+     does not contain CRYPTO frame.  It leaves negotiated version
+     unchanged. */
+  setup_handshake_client(&conn);
+
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+
+  CU_ASSERT(spktlen > 0);
+
+  fr.type = NGTCP2_FRAME_PADDING;
+  fr.padding.len = 1;
+
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
+      ngtcp2_conn_get_dcid(conn), pkt_num++, NGTCP2_PROTO_VER_V1, &fr,
+      &null_ckm);
 
-  CU_ASSERT(0 == rv);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(NGTCP2_ECN_STATE_FAILED == conn->tx.ecn.state);
-  CU_ASSERT(NGTCP2_ECN_MAX_NUM_VALIDATION_PKTS ==
-            conn->pktns.tx.ecn.validation_pkt_lost);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == conn->negotiated_version);
+  CU_ASSERT(0 == conn->vneg.version);
+  CU_ASSERT(conn->vneg.rx.ckm == NULL);
+  CU_ASSERT(conn->vneg.tx.ckm == NULL);
 
   ngtcp2_conn_del(conn);
 
-  /* ECN validation fails if all ECN marked packets sent in last 3 *
-     RTT are lost */
-  setup_default_client(&conn);
+  /* Server sees client supports QUIC v2.  It chooses QUIC v2 as the
+     negotiated version, and generates new Initial keys. */
+  setup_handshake_server(&conn);
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  conn->callbacks.recv_client_initial =
+      recv_client_initial_no_remote_transport_params;
 
-  CU_ASSERT(0 == rv);
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 1233;
+  fr.crypto.data[0].base = null_data;
 
-  for (i = 0; i < 2; ++i) {
-    spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf),
-                                       &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
-                                       stream_id, null_data, 25, 0);
+  pktlen = write_single_frame_handshake_pkt(
+      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
+      ngtcp2_conn_get_dcid(conn), pkt_num++, NGTCP2_PROTO_VER_V1, &fr,
+      &null_ckm);
 
-    CU_ASSERT(0 < spktlen);
-    CU_ASSERT(NGTCP2_ECN_ECT_0 == pi.ecn);
-  }
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  CU_ASSERT(NGTCP2_ECN_STATE_TESTING == conn->tx.ecn.state);
-  CU_ASSERT(2 == conn->tx.ecn.dgram_sent);
+  CU_ASSERT(0 == rv);
 
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf), &nwrite,
-                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
-                                     null_data, 25, 3 * NGTCP2_SECONDS);
+  ngtcp2_transport_params_default(&remote_params);
+  ngtcp2_cid_init(&remote_params.initial_scid, conn->dcid.current.cid.data,
+                  conn->dcid.current.cid.datalen);
+  remote_params.version_info_present = 1;
+  remote_params.version_info.chosen_version = NGTCP2_PROTO_VER_V1;
+  remote_params.version_info.other_versions = other_versions;
+  remote_params.version_info.other_versionslen = sizeof(other_versions);
 
-  CU_ASSERT(0 < spktlen);
-  CU_ASSERT(NGTCP2_ECN_NOT_ECT == pi.ecn);
-  CU_ASSERT(NGTCP2_ECN_STATE_UNKNOWN == conn->tx.ecn.state);
-  CU_ASSERT(0 == conn->tx.ecn.validation_start_ts);
-  CU_ASSERT(0 == conn->pktns.tx.ecn.start_pkt_num);
-  CU_ASSERT(2 == conn->pktns.tx.ecn.validation_pkt_sent);
-  CU_ASSERT(0 == conn->pktns.tx.ecn.validation_pkt_lost);
+  rv = ngtcp2_conn_set_remote_transport_params(conn, &remote_params);
 
-  fr.type = NGTCP2_FRAME_ACK;
-  fr.ack.largest_ack = 2;
-  fr.ack.ack_delay = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_PROTO_VER_V2_DRAFT == conn->negotiated_version);
+  CU_ASSERT(NGTCP2_PROTO_VER_V2_DRAFT == conn->vneg.version);
+  CU_ASSERT(conn->vneg.rx.ckm != NULL);
+  CU_ASSERT(conn->vneg.tx.ckm != NULL);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
-                                  conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen,
-                            4 * NGTCP2_SECONDS);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NGTCP2_ECN_STATE_FAILED == conn->tx.ecn.state);
-  CU_ASSERT(2 == conn->pktns.tx.ecn.validation_pkt_lost);
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(NGTCP2_PROTO_VER_V2_DRAFT == ngtcp2_get_uint32(&buf[1]));
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_path_validation(void) {
+void test_ngtcp2_conn_server_negotiate_version(void) {
   ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  size_t pktlen;
-  ngtcp2_ssize spktlen;
-  ngtcp2_tstamp t = 0;
-  int64_t pkt_num = 0;
-  ngtcp2_frame frs[4];
-  int rv;
-  ngtcp2_path_storage rpath, wpath;
-  ngtcp2_pv_entry *ent;
+  ngtcp2_version_info version_info = {0};
+  uint8_t client_other_versions[sizeof(uint32_t) * 2];
 
-  /* server starts path validation in NAT rebinding scenario. */
-  setup_default_server(&conn);
+  setup_handshake_server(&conn);
 
-  /* This will send NEW_CONNECTION_ID frames */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  version_info.chosen_version = conn->client_chosen_version;
 
-  CU_ASSERT(spktlen > 0);
+  /* Empty version_info.other_versions */
+  version_info.other_versions = NULL;
+  version_info.other_versionslen = 0;
 
-  frs[0].type = NGTCP2_FRAME_PING;
+  CU_ASSERT(conn->client_chosen_version ==
+            ngtcp2_conn_server_negotiate_version(conn, &version_info));
 
-  /* Just change remote port */
-  path_init(&rpath, 0, 0, 0, 1);
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 1,
-                     conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &rpath.path, &null_pi, buf, pktlen, ++t);
+  /* version_info.other_versions and preferred_versions do not share
+     any version. */
+  ngtcp2_put_uint32be(&client_other_versions[0], 0xff000001);
+  ngtcp2_put_uint32be(&client_other_versions[4], 0xff000002);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NULL != conn->pv);
-  CU_ASSERT(0 == conn->pv->dcid.seq);
-  CU_ASSERT(ngtcp2_path_eq(&conn->pv->dcid.ps.path, &rpath.path));
+  version_info.other_versions = client_other_versions;
+  version_info.other_versionslen = sizeof(uint32_t) * 2;
 
-  ngtcp2_path_storage_zero(&wpath);
-  spktlen =
-      ngtcp2_conn_write_pkt(conn, &wpath.path, NULL, buf, sizeof(buf), ++t);
+  CU_ASSERT(conn->client_chosen_version ==
+            ngtcp2_conn_server_negotiate_version(conn, &version_info));
 
-  /* Server has not received enough bytes to pad probing packet. */
-  CU_ASSERT(1200 > spktlen);
-  CU_ASSERT(ngtcp2_path_eq(&rpath.path, &wpath.path));
-  CU_ASSERT(1 == ngtcp2_ringbuf_len(&conn->pv->ents.rb));
+  /* version_info.other_versions and preferred_versions share the
+     version. */
+  ngtcp2_put_uint32be(&client_other_versions[0], 0xff000001);
+  ngtcp2_put_uint32be(&client_other_versions[4], NGTCP2_PROTO_VER_V2_DRAFT);
 
-  ent = ngtcp2_ringbuf_get(&conn->pv->ents.rb, 0);
+  version_info.other_versions = client_other_versions;
+  version_info.other_versionslen = sizeof(uint32_t) * 2;
 
-  CU_ASSERT(ent->flags & NGTCP2_PV_ENTRY_FLAG_UNDERSIZED);
-  CU_ASSERT(conn->pv->flags & NGTCP2_PV_FLAG_FALLBACK_ON_FAILURE);
-  CU_ASSERT(!(conn->pv->flags & NGTCP2_PV_FLAG_MTU_PROBE));
+  CU_ASSERT(NGTCP2_PROTO_VER_V2_DRAFT ==
+            ngtcp2_conn_server_negotiate_version(conn, &version_info));
 
-  frs[0].type = NGTCP2_FRAME_PATH_RESPONSE;
-  memcpy(frs[0].path_response.data, ent->data, sizeof(ent->data));
+  ngtcp2_conn_del(conn);
 
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 1,
-                     conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &rpath.path, &null_pi, buf, pktlen, ++t);
+  /* Without preferred_versions */
+  setup_handshake_server(&conn);
 
-  CU_ASSERT(0 == rv);
+  ngtcp2_mem_free(conn->mem, conn->vneg.preferred_versions);
+  conn->vneg.preferred_versions = NULL;
+  conn->vneg.preferred_versionslen = 0;
 
-  /* Start another path validation to probe least MTU */
-  CU_ASSERT(NULL != conn->pv);
-  CU_ASSERT(conn->pv->flags & NGTCP2_PV_FLAG_FALLBACK_ON_FAILURE);
-  CU_ASSERT(conn->pv->flags & NGTCP2_PV_FLAG_MTU_PROBE);
+  ngtcp2_put_uint32be(&client_other_versions[0], 0xff000001);
+  ngtcp2_put_uint32be(&client_other_versions[4], NGTCP2_PROTO_VER_V2_DRAFT);
 
-  ngtcp2_path_storage_zero(&wpath);
-  spktlen =
-      ngtcp2_conn_write_pkt(conn, &wpath.path, NULL, buf, sizeof(buf), ++t);
+  version_info.other_versions = client_other_versions;
+  version_info.other_versionslen = sizeof(uint32_t) * 2;
 
-  CU_ASSERT(1200 <= spktlen);
-  CU_ASSERT(ngtcp2_path_eq(&rpath.path, &wpath.path));
-  CU_ASSERT(1 == ngtcp2_ringbuf_len(&conn->pv->ents.rb));
+  CU_ASSERT(conn->client_chosen_version ==
+            ngtcp2_conn_server_negotiate_version(conn, &version_info));
 
-  ent = ngtcp2_ringbuf_get(&conn->pv->ents.rb, 0);
-  frs[0].type = NGTCP2_FRAME_PATH_RESPONSE;
-  memcpy(frs[0].path_response.data, ent->data, sizeof(ent->data));
+  ngtcp2_conn_del(conn);
 
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 1,
-                     conn->pktns.crypto.rx.ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &rpath.path, &null_pi, buf, pktlen, ++t);
+  /* original version is the most preferred version */
+  setup_handshake_server(&conn);
 
-  CU_ASSERT(0 == rv);
+  conn->vneg.preferred_versions[0] = NGTCP2_PROTO_VER_V1;
+  conn->vneg.preferred_versions[1] = NGTCP2_PROTO_VER_V2_DRAFT;
 
-  /* Now perform another validation to old path */
-  CU_ASSERT(NULL != conn->pv);
-  CU_ASSERT(!(conn->pv->flags & NGTCP2_PV_FLAG_FALLBACK_ON_FAILURE));
-  CU_ASSERT(!(conn->pv->flags & NGTCP2_PV_FLAG_MTU_PROBE));
-  CU_ASSERT(conn->pv->flags & NGTCP2_PV_FLAG_DONT_CARE);
+  ngtcp2_put_uint32be(&client_other_versions[0], NGTCP2_PROTO_VER_V2_DRAFT);
+  ngtcp2_put_uint32be(&client_other_versions[4], NGTCP2_PROTO_VER_V1);
 
-  ngtcp2_path_storage_zero(&wpath);
-  spktlen =
-      ngtcp2_conn_write_pkt(conn, &wpath.path, NULL, buf, sizeof(buf), ++t);
+  version_info.other_versions = client_other_versions;
+  version_info.other_versionslen = sizeof(uint32_t) * 2;
 
-  CU_ASSERT(1200 <= spktlen);
-  CU_ASSERT(ngtcp2_path_eq(&null_path.path, &wpath.path));
-  CU_ASSERT(1 == ngtcp2_ringbuf_len(&conn->pv->ents.rb));
+  CU_ASSERT(conn->client_chosen_version ==
+            ngtcp2_conn_server_negotiate_version(conn, &version_info));
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_early_data_sync_stream_data_limit(void) {
+void test_ngtcp2_conn_pmtud_loss(void) {
   ngtcp2_conn *conn;
-  uint8_t buf[1024];
+  uint8_t buf[2048];
   ngtcp2_ssize spktlen;
-  ngtcp2_ssize datalen;
-  int64_t bidi_stream_id, uni_stream_id;
-  int rv;
+  uint64_t t = 0;
   ngtcp2_frame fr;
+  int64_t pkt_num = 0;
   size_t pktlen;
-  ngtcp2_crypto_aead_ctx aead_ctx = {0};
-  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
-  ngtcp2_transport_params params;
-  ngtcp2_strm *strm;
-  ngtcp2_tstamp t = 0;
+  int rv;
 
-  setup_early_client(&conn);
+  setup_default_client(&conn);
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &bidi_stream_id, NULL);
+  ngtcp2_conn_start_pmtud(conn);
 
-  CU_ASSERT(0 == rv);
+  /* This sends PMTUD packet. */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
-                                     &datalen, NGTCP2_WRITE_STREAM_FLAG_FIN,
-                                     bidi_stream_id, null_data, 1024, ++t);
+  CU_ASSERT(1406 == spktlen);
 
-  CU_ASSERT((ngtcp2_ssize)sizeof(buf) == spktlen);
-  CU_ASSERT(670 == datalen);
+  t += NGTCP2_SECONDS;
 
-  rv = ngtcp2_conn_open_uni_stream(conn, &uni_stream_id, NULL);
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(spktlen > 0);
 
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
-                                     &datalen, NGTCP2_WRITE_STREAM_FLAG_FIN,
-                                     uni_stream_id, null_data, 1024, ++t);
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
 
-  CU_ASSERT((ngtcp2_ssize)sizeof(buf) == spktlen);
-  CU_ASSERT(958);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, pkt_num++,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 198;
-  fr.crypto.data[0].base = null_data;
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
-      ngtcp2_conn_get_dcid(conn), 0, NGTCP2_PROTO_VER_V1, &fr, &null_ckm);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == conn->pktns.rtb.num_lost_pkts);
+  CU_ASSERT(1 == conn->pktns.rtb.num_lost_pmtud_pkts);
+  CU_ASSERT(0 == conn->pktns.rtb.cc_bytes_in_flight);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  ngtcp2_conn_del(conn);
+}
 
-  CU_ASSERT(0 == rv);
+void test_ngtcp2_conn_pmtud_probe_data(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  ngtcp2_ssize spktlen, nwrite;
+  uint64_t t = 0;
+  ngtcp2_frame fr;
+  int64_t pkt_num = 0;
+  int64_t stream_id;
+  size_t pktlen;
+  ngtcp2_rtb_entry *ent;
+  ngtcp2_rtb_it it;
+  ngtcp2_strm *strm;
+  int rv;
 
-  rv = ngtcp2_conn_install_rx_handshake_key(conn, &aead_ctx, null_iv,
-                                            sizeof(null_iv), &hp_ctx);
+  setup_default_client(&conn);
 
-  CU_ASSERT(0 == rv);
+  conn->local.settings.pmtud_probe_data = 1;
 
-  rv = ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
-                                            sizeof(null_iv), &hp_ctx);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
 
-  rv = ngtcp2_conn_install_rx_key(conn, null_secret, sizeof(null_secret),
-                                  &aead_ctx, null_iv, sizeof(null_iv), &hp_ctx);
+  ngtcp2_conn_start_pmtud(conn);
 
-  CU_ASSERT(0 == rv);
+  /* This sends PMTUD packet which carries stream data. */
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, null_data, 100, ++t);
 
-  memset(&params, 0, sizeof(params));
-  ngtcp2_cid_init(&params.initial_scid, conn->dcid.current.cid.data,
-                  conn->dcid.current.cid.datalen);
-  ngtcp2_cid_init(&params.original_dcid, conn->rcid.data, conn->rcid.datalen);
-  params.max_udp_payload_size = 1200;
-  params.initial_max_stream_data_bidi_local =
-      conn->early.transport_params.initial_max_stream_data_bidi_local;
-  params.initial_max_stream_data_bidi_remote = 640 * 1024;
-  params.initial_max_stream_data_uni = 320 * 1024;
-  params.initial_max_data = conn->early.transport_params.initial_max_data;
-  params.initial_max_streams_bidi =
-      conn->early.transport_params.initial_max_streams_bidi;
-  params.initial_max_streams_uni =
-      conn->early.transport_params.initial_max_streams_uni;
-  params.active_connection_id_limit =
-      conn->early.transport_params.active_connection_id_limit;
+  CU_ASSERT(1406 == spktlen);
+  CU_ASSERT(100 == nwrite);
 
-  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+  it = ngtcp2_rtb_head(&conn->pktns.rtb);
+  ent = ngtcp2_rtb_it_get(&it);
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(conn->pktns.tx.last_pkt_num == ent->hd.pkt_num);
+  CU_ASSERT(ent->flags & NGTCP2_RTB_ENTRY_FLAG_PMTUD_PROBE);
+  CU_ASSERT(ent->flags & NGTCP2_RTB_ENTRY_FLAG_RETRANSMITTABLE);
 
-  rv = ngtcp2_conn_install_tx_key(conn, null_secret, sizeof(null_secret),
-                                  &aead_ctx, null_iv, sizeof(null_iv), &hp_ctx);
+  t += NGTCP2_SECONDS;
 
-  CU_ASSERT(0 == rv);
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, null_data, 100, ++t);
 
-  ngtcp2_conn_handshake_completed(conn);
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(spktlen < 1406);
+  CU_ASSERT(100 == nwrite);
 
-  CU_ASSERT(0 < spktlen);
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
 
-  strm = ngtcp2_conn_find_stream(conn, bidi_stream_id);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, pkt_num++,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  CU_ASSERT(params.initial_max_stream_data_bidi_remote == strm->tx.max_offset);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  strm = ngtcp2_conn_find_stream(conn, uni_stream_id);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == conn->pktns.rtb.num_lost_pmtud_pkts);
+  CU_ASSERT(0 == conn->cstat.lost_pkt_count);
+  CU_ASSERT(UINT64_MAX == conn->cstat.congestion_recovery_start_ts);
 
-  CU_ASSERT(params.initial_max_stream_data_uni == strm->tx.max_offset);
+  /* The stream data in the lost probe is retransmitted. */
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
+
+  CU_ASSERT(!ngtcp2_strm_streamfrq_empty(strm));
+  CU_ASSERT(1 == conn->tx.strmq_nretrans);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_early_data_rejected(void) {
+void test_ngtcp2_conn_pmtud_black_hole(void) {
   ngtcp2_conn *conn;
-  uint8_t buf[1024];
+  uint8_t buf[2048];
   ngtcp2_ssize spktlen;
-  ngtcp2_ssize datalen;
-  int64_t bidi_stream_id, uni_stream_id;
-  int rv;
+  ngtcp2_ssize nwrite;
+  uint64_t t = 0;
   ngtcp2_frame fr;
+  int64_t pkt_num = 0;
+  int64_t stream_id;
   size_t pktlen;
-  ngtcp2_crypto_aead_ctx aead_ctx = {0};
-  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
-  ngtcp2_transport_params params;
-  ngtcp2_tstamp t = 0;
+  size_t i;
+  int rv;
 
-  setup_early_client(&conn);
+  setup_default_client(&conn);
 
-  rv = ngtcp2_conn_open_bidi_stream(conn, &bidi_stream_id, NULL);
+  /* Pretend that Path MTU Discovery has finished. */
+  conn->local.settings.no_udp_payload_size_shaping = 0;
+  conn->dcid.current.max_udp_payload_size = 1452;
+
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
 
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
-                                     &datalen, NGTCP2_WRITE_STREAM_FLAG_FIN,
-                                     bidi_stream_id, null_data, 1024, ++t);
+  /* 3 full sized packets followed by 3 small packets */
+  for (i = 0; i < 3; ++i) {
+    spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                       &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                       stream_id, null_data, 2048, ++t);
 
-  CU_ASSERT((ngtcp2_ssize)sizeof(buf) == spktlen);
-  CU_ASSERT(670 == datalen);
+    CU_ASSERT(1452 == spktlen);
+  }
 
-  rv = ngtcp2_conn_open_uni_stream(conn, &uni_stream_id, NULL);
+  for (i = 0; i < 3; ++i) {
+    spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                       &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                       stream_id, null_data, 10, ++t);
 
-  CU_ASSERT(0 == rv);
+    CU_ASSERT(spktlen > 0);
+    CU_ASSERT(spktlen <= NGTCP2_MAX_UDP_PAYLOAD_SIZE);
+  }
 
-  ngtcp2_conn_extend_max_offset(conn, 1000);
-  ngtcp2_conn_extend_max_streams_bidi(conn, 7);
-  ngtcp2_conn_extend_max_streams_uni(conn, 5);
+  /* Acknowledging the last small packet declares the full sized
+     packets lost. */
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
 
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
-                                     &datalen, NGTCP2_WRITE_STREAM_FLAG_FIN,
-                                     uni_stream_id, null_data, 300, ++t);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, pkt_num++,
+                                  &fr, conn->pktns.crypto.rx.ckm);
 
-  CU_ASSERT(0 < spktlen);
-  CU_ASSERT(0 < conn->tx.offset);
-  CU_ASSERT(conn->local.transport_params.initial_max_data + 1000 ==
-            conn->rx.unsent_max_offset);
-  CU_ASSERT(conn->local.transport_params.initial_max_streams_bidi + 7 ==
-            conn->remote.bidi.unsent_max_streams);
-  CU_ASSERT(conn->local.transport_params.initial_max_streams_bidi + 7 ==
-            conn->remote.bidi.max_streams);
-  CU_ASSERT(conn->local.transport_params.initial_max_streams_uni + 5 ==
-            conn->remote.uni.unsent_max_streams);
-  CU_ASSERT(conn->local.transport_params.initial_max_streams_uni + 5 ==
-            conn->remote.uni.max_streams);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 198;
-  fr.crypto.data[0].base = null_data;
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_MAX_UDP_PAYLOAD_SIZE ==
+            conn->dcid.current.max_udp_payload_size);
+  CU_ASSERT(0 == conn->pmtud_bh.num_lost);
+  CU_ASSERT(conn->pktns.tx.last_pkt_num == conn->pmtud_bh.max_ack_pkt_num);
+  CU_ASSERT(NULL != conn->pmtud);
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
-      ngtcp2_conn_get_dcid(conn), 0, NGTCP2_PROTO_VER_V1, &fr, &null_ckm);
+  ngtcp2_conn_del(conn);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  /* Full sized packet acknowledged after the lost ones is not a black
+     hole. */
+  setup_default_client(&conn);
 
-  CU_ASSERT(0 == rv);
+  conn->local.settings.no_udp_payload_size_shaping = 0;
+  conn->dcid.current.max_udp_payload_size = 1452;
 
-  rv = ngtcp2_conn_install_rx_handshake_key(conn, &aead_ctx, null_iv,
-                                            sizeof(null_iv), &hp_ctx);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
 
-  rv = ngtcp2_conn_install_tx_handshake_key(conn, &aead_ctx, null_iv,
-                                            sizeof(null_iv), &hp_ctx);
+  for (i = 0; i < 6; ++i) {
+    spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                       &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                       stream_id, null_data, 2048, ++t);
 
-  CU_ASSERT(0 == rv);
+    CU_ASSERT(1452 == spktlen);
+  }
 
-  rv = ngtcp2_conn_install_rx_key(conn, null_secret, sizeof(null_secret),
-                                  &aead_ctx, null_iv, sizeof(null_iv), &hp_ctx);
+  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, pkt_num++,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
 
   CU_ASSERT(0 == rv);
+  CU_ASSERT(1452 == conn->dcid.current.max_udp_payload_size);
+  CU_ASSERT(0 == conn->pmtud_bh.num_lost);
+  CU_ASSERT(5 == conn->pmtud_bh.max_ack_pkt_num);
 
-  /* Stream limits in transport parameters can be reduced if early
-     data is rejected. */
-  memset(&params, 0, sizeof(params));
-  ngtcp2_cid_init(&params.initial_scid, conn->dcid.current.cid.data,
-                  conn->dcid.current.cid.datalen);
-  ngtcp2_cid_init(&params.original_dcid, conn->rcid.data, conn->rcid.datalen);
-  params.max_udp_payload_size = 1200;
-  params.initial_max_stream_data_bidi_local =
-      conn->early.transport_params.initial_max_stream_data_bidi_local;
-  params.initial_max_stream_data_bidi_remote =
-      conn->early.transport_params.initial_max_stream_data_bidi_remote / 2;
-  params.initial_max_stream_data_uni = 0;
-  params.initial_max_data = conn->early.transport_params.initial_max_data;
-  params.initial_max_streams_bidi =
-      conn->early.transport_params.initial_max_streams_bidi;
-  params.initial_max_streams_uni =
-      conn->early.transport_params.initial_max_streams_uni;
-  params.active_connection_id_limit =
-      conn->early.transport_params.active_connection_id_limit;
+  ngtcp2_conn_del(conn);
+}
 
-  rv = ngtcp2_conn_set_remote_transport_params(conn, &params);
+static void user_cc_reset(ngtcp2_conn *conn, ngtcp2_conn_stat *cstat,
+                          ngtcp2_tstamp ts, void *user_data) {
+  my_user_data *ud = user_data;
+  (void)conn;
+  (void)ts;
 
-  CU_ASSERT(0 == rv);
+  ++ud->user_cc.reset;
+  cstat->cwnd = 100000;
+}
 
-  rv = ngtcp2_conn_install_tx_key(conn, null_secret, sizeof(null_secret),
-                                  &aead_ctx, null_iv, sizeof(null_iv), &hp_ctx);
+static void user_cc_on_pkt_sent(ngtcp2_conn *conn, ngtcp2_conn_stat *cstat,
+                                const ngtcp2_cc_pkt *pkt, void *user_data) {
+  my_user_data *ud = user_data;
+  (void)conn;
+  (void)cstat;
+  (void)pkt;
 
-  CU_ASSERT(0 == rv);
+  ++ud->user_cc.on_pkt_sent;
+}
 
-  ngtcp2_conn_handshake_completed(conn);
-  ngtcp2_conn_early_data_rejected(conn);
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+static void user_cc_on_pkt_acked(ngtcp2_conn *conn, ngtcp2_conn_stat *cstat,
+                                 const ngtcp2_cc_pkt *pkt, ngtcp2_tstamp ts,
+                                 void *user_data) {
+  my_user_data *ud = user_data;
+  (void)conn;
+  (void)ts;
 
-  CU_ASSERT(0 < spktlen);
-  CU_ASSERT(NULL == ngtcp2_conn_find_stream(conn, bidi_stream_id));
-  CU_ASSERT(NULL == ngtcp2_conn_find_stream(conn, uni_stream_id));
-  CU_ASSERT(0 == conn->tx.offset);
-  CU_ASSERT(conn->local.transport_params.initial_max_data ==
-            conn->rx.max_offset);
-  CU_ASSERT(conn->local.transport_params.initial_max_data ==
-            conn->rx.unsent_max_offset);
-  CU_ASSERT(conn->local.transport_params.initial_max_streams_bidi ==
-            conn->remote.bidi.max_streams);
-  CU_ASSERT(conn->local.transport_params.initial_max_streams_bidi ==
-            conn->remote.bidi.unsent_max_streams);
-  CU_ASSERT(conn->local.transport_params.initial_max_streams_uni ==
-            conn->remote.uni.max_streams);
-  CU_ASSERT(conn->local.transport_params.initial_max_streams_uni ==
-            conn->remote.uni.unsent_max_streams);
+  ++ud->user_cc.on_pkt_acked;
+  cstat->cwnd += pkt->pktlen;
+}
 
-  ngtcp2_conn_del(conn);
+static void user_cc_new_rtt_sample(ngtcp2_conn *conn, ngtcp2_conn_stat *cstat,
+                                   ngtcp2_tstamp ts, void *user_data) {
+  my_user_data *ud = user_data;
+  (void)conn;
+  (void)cstat;
+  (void)ts;
+
+  ++ud->user_cc.new_rtt_sample;
 }
 
-void test_ngtcp2_conn_keep_alive(void) {
+static void user_cc_on_ack_recv(ngtcp2_conn *conn, ngtcp2_conn_stat *cstat,
+                                const ngtcp2_cc_ack *ack,
+                                const ngtcp2_rate_sample *rs, ngtcp2_tstamp ts,
+                                void *user_data) {
+  my_user_data *ud = user_data;
+  (void)conn;
+  (void)cstat;
+  (void)ts;
+
+  ++ud->user_cc.on_ack_recv;
+  ud->user_cc.bytes_delivered += ack->bytes_delivered;
+  ud->user_cc.rs_present = rs != NULL;
+}
+
+void test_ngtcp2_conn_user_cc(void) {
   ngtcp2_conn *conn;
+  ngtcp2_cc_callbacks cc_callbacks = {0};
+  my_user_data ud;
   uint8_t buf[2048];
   ngtcp2_ssize spktlen;
-  ngtcp2_pkt_info pi;
-  ngtcp2_tstamp t = 0;
+  size_t pktlen;
+  ngtcp2_frame fr;
+  int64_t stream_id;
+  ngtcp2_ssize nwrite;
   int rv;
 
+  cc_callbacks.reset = user_cc_reset;
+  cc_callbacks.on_pkt_sent = user_cc_on_pkt_sent;
+  cc_callbacks.on_pkt_acked = user_cc_on_pkt_acked;
+  cc_callbacks.new_rtt_sample = user_cc_new_rtt_sample;
+  cc_callbacks.on_ack_recv = user_cc_on_ack_recv;
+
   setup_default_client(&conn);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, &pi, buf, sizeof(buf), ++t);
+  memset(&ud, 0, sizeof(ud));
+  conn->user_data = &ud;
 
-  CU_ASSERT(0 < spktlen);
+  rv = ngtcp2_conn_set_cc_callbacks(conn, &cc_callbacks);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, &pi, buf, sizeof(buf), ++t);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(conn->flags & NGTCP2_CONN_FLAG_USER_CC);
+  CU_ASSERT(1 == ud.user_cc.reset);
+  CU_ASSERT(100000 == conn->cstat.cwnd);
+  CU_ASSERT(NULL == conn->cc.on_pkt_lost);
+  CU_ASSERT(NULL == conn->cc.on_spurious_congestion);
 
-  CU_ASSERT(0 == spktlen);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
-  ngtcp2_conn_set_keep_alive_timeout(conn, 10 * NGTCP2_SECONDS);
+  CU_ASSERT(0 == rv);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, &pi, buf, sizeof(buf), t);
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, null_data, 1024, 1);
 
-  CU_ASSERT(0 == spktlen);
+  CU_ASSERT(0 < spktlen);
+  CU_ASSERT(1 == ud.user_cc.on_pkt_sent);
 
-  t += 10 * NGTCP2_SECONDS;
+  /* The controller cannot be replaced after a packet is written. */
+  rv = ngtcp2_conn_set_cc_callbacks(conn, &cc_callbacks);
 
-  rv = ngtcp2_conn_handle_expiry(conn, t);
+  CU_ASSERT(NGTCP2_ERR_INVALID_STATE == rv);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(conn->flags & NGTCP2_CONN_FLAG_KEEP_ALIVE_CANCELLED);
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = 0;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, &pi, buf, sizeof(buf), t);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen,
+                            10 * NGTCP2_MILLISECONDS);
 
-  CU_ASSERT(0 < spktlen);
-  CU_ASSERT(t == conn->keep_alive.last_ts);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == ud.user_cc.on_pkt_acked);
+  CU_ASSERT(1 == ud.user_cc.new_rtt_sample);
+  CU_ASSERT(1 == ud.user_cc.on_ack_recv);
+  CU_ASSERT((uint64_t)spktlen == ud.user_cc.bytes_delivered);
+  CU_ASSERT(ud.user_cc.rs_present);
+  CU_ASSERT(100000 + (uint64_t)spktlen == conn->cstat.cwnd);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_retire_stale_bound_dcid(void) {
+void test_ngtcp2_conn_cc_resume(void) {
   ngtcp2_conn *conn;
   uint8_t buf[2048];
+  ngtcp2_ssize spktlen;
   size_t pktlen;
-  ngtcp2_tstamp t = 0;
-  ngtcp2_tstamp expiry;
-  int64_t pkt_num = 0;
   ngtcp2_frame fr;
+  int64_t stream_id;
+  ngtcp2_ssize nwrite;
+  ngtcp2_cc_resume_params params;
+  int64_t pkt_num = 0;
   int rv;
-  ngtcp2_cid cid;
   const uint8_t raw_cid[] = {0x0f, 0x00, 0x00, 0x00};
   const uint8_t token[NGTCP2_STATELESS_RESET_TOKENLEN] = {0xff};
-  const uint8_t data[] = {0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8};
+  ngtcp2_tstamp t = 0;
+  size_t i;
 
-  ngtcp2_cid_init(&cid, raw_cid, sizeof(raw_cid));
+  /* The congestion window jumps, and it is validated. */
+  setup_default_client(&conn);
 
-  setup_default_server(&conn);
+  conn->cc_resume.params.min_rtt = 20 * NGTCP2_MILLISECONDS;
+  conn->cc_resume.params.max_bw = 25000000;
+  conn->cc_resume.params.cwnd = 1000000;
+  conn->cc_resume.phase = NGTCP2_CC_RESUME_PHASE_RECONNAISSANCE;
 
-  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
-  fr.new_connection_id.seq = 1;
-  fr.new_connection_id.retire_prior_to = 0;
-  fr.new_connection_id.cid = cid;
-  memcpy(fr.new_connection_id.stateless_reset_token, token, sizeof(token));
+  ngtcp2_conn_get_cc_resume_params(conn, &params);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  CU_ASSERT(0 == params.cwnd);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
 
-  fr.type = NGTCP2_FRAME_PATH_CHALLENGE;
-  memcpy(fr.path_challenge.data, data, sizeof(fr.path_challenge.data));
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, null_data, 1024, 0);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  CU_ASSERT(0 < spktlen);
 
-  rv = ngtcp2_conn_read_pkt(conn, &new_path.path, &null_pi, buf, pktlen, ++t);
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = 0;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, pkt_num++,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen,
+                            10 * NGTCP2_MILLISECONDS);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(ngtcp2_ringbuf_len(&conn->rx.path_challenge.rb) > 0);
-  CU_ASSERT(ngtcp2_ringbuf_len(&conn->dcid.bound.rb) > 0);
+  CU_ASSERT(NGTCP2_CC_RESUME_PHASE_UNVALIDATED == conn->cc_resume.phase);
+  /* Capped by the saved bandwidth-delay product */
+  CU_ASSERT(500000 == conn->cstat.cwnd);
+  CU_ASSERT(500000 == conn->cstat.ssthresh);
+  CU_ASSERT(conn->cstat.pacing_rate > 0);
+  CU_ASSERT(1 == conn->cc_resume.pkt_num);
 
-  expiry = ngtcp2_conn_get_expiry(conn);
+  spktlen = ngtcp2_conn_write_stream(
+      conn, NULL, NULL, buf, sizeof(buf), &nwrite,
+      NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id, null_data, 1024,
+      10 * NGTCP2_MILLISECONDS);
 
-  CU_ASSERT(UINT64_MAX != expiry);
+  CU_ASSERT(0 < spktlen);
 
-  t += 3 * ngtcp2_conn_get_pto(conn);
+  fr.ack.largest_ack = 1;
 
-  rv = ngtcp2_conn_handle_expiry(conn, t);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, pkt_num++,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen,
+                            20 * NGTCP2_MILLISECONDS);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(0 == ngtcp2_ringbuf_len(&conn->dcid.bound.rb));
+  CU_ASSERT(NGTCP2_CC_RESUME_PHASE_NONE == conn->cc_resume.phase);
+  CU_ASSERT(conn->cstat.cwnd >= 500000);
+  CU_ASSERT(!(conn->cstat.pacing_rate > 0));
 
-  ngtcp2_conn_del(conn);
-}
-
-void test_ngtcp2_conn_get_scid(void) {
-  ngtcp2_conn *conn;
-  ngtcp2_settings settings;
-  ngtcp2_transport_params params;
-  ngtcp2_cid dcid, scid;
-  ngtcp2_callbacks cb;
-  const uint8_t raw_cid[] = {0x0f, 0x00, 0x00, 0x00};
-  ngtcp2_cid scids[16];
+  ngtcp2_conn_get_cc_resume_params(conn, &params);
 
-  dcid_init(&dcid);
-  dcid_init(&scid);
+  CU_ASSERT(10 * NGTCP2_MILLISECONDS == params.min_rtt);
+  CU_ASSERT(conn->cstat.cwnd == params.cwnd);
 
-  server_default_callbacks(&cb);
-  server_default_settings(&settings);
+  ngtcp2_conn_del(conn);
 
-  /* Without preferred address */
-  server_default_transport_params(&params);
+  /* Congestion before validation makes the congestion window
+     retreat. */
+  pkt_num = 0;
 
-  ngtcp2_conn_server_new(&conn, &dcid, &scid, &null_path.path,
-                         NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
-                         /* mem = */ NULL, NULL);
+  setup_default_client(&conn);
 
-  CU_ASSERT(1 == ngtcp2_conn_get_num_scid(conn));
+  conn->cc_resume.params.min_rtt = 20 * NGTCP2_MILLISECONDS;
+  conn->cc_resume.params.max_bw = 0;
+  conn->cc_resume.params.cwnd = 1000000;
+  conn->cc_resume.phase = NGTCP2_CC_RESUME_PHASE_RECONNAISSANCE;
 
-  ngtcp2_conn_get_scid(conn, scids);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
-  CU_ASSERT(ngtcp2_cid_eq(&scid, &scids[0]));
+  CU_ASSERT(0 == rv);
 
-  ngtcp2_conn_del(conn);
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, null_data, 1024, 0);
 
-  /* With preferred address */
-  server_default_transport_params(&params);
-  params.preferred_address_present = 1;
-  ngtcp2_cid_init(&params.preferred_address.cid, raw_cid, sizeof(raw_cid));
+  CU_ASSERT(0 < spktlen);
 
-  ngtcp2_conn_server_new(&conn, &dcid, &scid, &null_path.path,
-                         NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
-                         /* mem = */ NULL, NULL);
+  fr.ack.largest_ack = 0;
 
-  CU_ASSERT(2 == ngtcp2_conn_get_num_scid(conn));
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, pkt_num++,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen,
+                            10 * NGTCP2_MILLISECONDS);
 
-  ngtcp2_conn_get_scid(conn, scids);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_CC_RESUME_PHASE_UNVALIDATED == conn->cc_resume.phase);
+  CU_ASSERT(500000 == conn->cstat.cwnd);
 
-  CU_ASSERT(ngtcp2_cid_eq(&scid, &scids[0]));
-  CU_ASSERT(ngtcp2_cid_eq(&params.preferred_address.cid, &scids[1]));
+  spktlen = ngtcp2_conn_write_stream(
+      conn, NULL, NULL, buf, sizeof(buf), &nwrite,
+      NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id, null_data, 1024,
+      10 * NGTCP2_MILLISECONDS);
 
-  ngtcp2_conn_del(conn);
-}
+  CU_ASSERT(0 < spktlen);
 
-void test_ngtcp2_conn_stream_close(void) {
-  ngtcp2_conn *conn;
-  int rv;
-  uint8_t buf[2048];
-  ngtcp2_frame frs[2];
-  size_t pktlen;
-  int64_t pkt_num = 0;
-  my_user_data ud;
-  ngtcp2_strm *strm;
-  ngtcp2_tstamp t = 0;
-  ngtcp2_ssize spktlen;
-  int64_t stream_id;
+  spktlen = ngtcp2_conn_write_stream(
+      conn, NULL, NULL, buf, sizeof(buf), &nwrite,
+      NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id, null_data, 1024,
+      11 * NGTCP2_MILLISECONDS);
 
-  /* Receive RESET_STREAM and STOP_SENDING from client */
-  setup_default_server(&conn);
-  conn->callbacks.stream_close = stream_close;
-  conn->user_data = &ud;
+  CU_ASSERT(0 < spktlen);
 
-  open_stream(conn, 0);
+  conn->cc.congestion_event(&conn->cc, &conn->cstat, 10 * NGTCP2_MILLISECONDS,
+                            11 * NGTCP2_MILLISECONDS);
 
-  frs[0].type = NGTCP2_FRAME_RESET_STREAM;
-  frs[0].reset_stream.stream_id = 0;
-  frs[0].reset_stream.app_error_code = NGTCP2_APP_ERR01;
-  frs[0].reset_stream.final_size = 999;
+  fr.ack.largest_ack = 2;
+  fr.ack.first_ack_blklen = 0;
 
-  frs[1].type = NGTCP2_FRAME_STOP_SENDING;
-  frs[1].stop_sending.stream_id = 0;
-  frs[1].stop_sending.app_error_code = NGTCP2_APP_ERR02;
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, pkt_num++,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen,
+                            20 * NGTCP2_MILLISECONDS);
 
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 2,
-                     conn->pktns.crypto.tx.ckm);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_CC_RESUME_PHASE_NONE == conn->cc_resume.phase);
+  CU_ASSERT(2 * conn->cstat.max_udp_payload_size == conn->cstat.cwnd);
+  CU_ASSERT(conn->cstat.cwnd == conn->cstat.ssthresh);
+  CU_ASSERT(!(conn->cstat.pacing_rate > 0));
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(0 == rv);
+  /* The saved path state is abandoned if RTT does not match. */
+  pkt_num = 0;
 
-  strm = ngtcp2_conn_find_stream(conn, 0);
+  setup_default_client(&conn);
 
-  CU_ASSERT(NGTCP2_APP_ERR01 == strm->app_error_code);
+  conn->cc_resume.params.min_rtt = 200 * NGTCP2_MILLISECONDS;
+  conn->cc_resume.params.cwnd = 1000000;
+  conn->cc_resume.phase = NGTCP2_CC_RESUME_PHASE_RECONNAISSANCE;
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT((size_t)spktlen < sizeof(buf));
+  CU_ASSERT(0 == rv);
 
-  frs[0].type = NGTCP2_FRAME_ACK;
-  frs[0].ack.largest_ack = 0;
-  frs[0].ack.ack_delay = 0;
-  frs[0].ack.first_ack_blklen = 0;
-  frs[0].ack.num_blks = 0;
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                     &nwrite, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                     stream_id, null_data, 1024, 0);
 
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 1,
-                     conn->pktns.crypto.tx.ckm);
+  CU_ASSERT(0 < spktlen);
 
-  ud.stream_close.flags = NGTCP2_STREAM_CLOSE_FLAG_NONE;
-  ud.stream_close.stream_id = -1;
-  ud.stream_close.app_error_code = 0;
+  fr.ack.largest_ack = 0;
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, pkt_num++,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen,
+                            10 * NGTCP2_MILLISECONDS);
 
   CU_ASSERT(0 == rv);
-
-  CU_ASSERT(NGTCP2_STREAM_CLOSE_FLAG_APP_ERROR_CODE_SET &
-            ud.stream_close.flags);
-  CU_ASSERT(0 == ud.stream_close.stream_id);
-  CU_ASSERT(NGTCP2_APP_ERR01 == ud.stream_close.app_error_code);
+  CU_ASSERT(NGTCP2_CC_RESUME_PHASE_NONE == conn->cc_resume.phase);
+  CU_ASSERT(conn->cstat.cwnd < 500000);
 
   ngtcp2_conn_del(conn);
 
-  /* Client sends STOP_SENDING and then STREAM and fin */
+  /* The state of a path is resumed when the connection migrates back
+     to it. */
   pkt_num = 0;
 
-  setup_default_server(&conn);
-  conn->callbacks.stream_close = stream_close;
-  conn->callbacks.recv_stream_data = recv_stream_data;
-  conn->user_data = &ud;
-
-  frs[0].type = NGTCP2_FRAME_STOP_SENDING;
-  frs[0].stop_sending.stream_id = 0;
-  frs[0].stop_sending.app_error_code = NGTCP2_APP_ERR01;
-
-  frs[1].type = NGTCP2_FRAME_STREAM;
-  frs[1].stream.flags = 0;
-  frs[1].stream.fin = 1;
-  frs[1].stream.stream_id = 0;
-  frs[1].stream.offset = 0;
-  frs[1].stream.datacnt = 0;
+  setup_default_client(&conn);
 
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 2,
-                     conn->pktns.crypto.tx.ckm);
+  fr.type = NGTCP2_FRAME_NEW_CONNECTION_ID;
+  fr.new_connection_id.retire_prior_to = 0;
+  memcpy(fr.new_connection_id.stateless_reset_token, token, sizeof(token));
 
-  ud.stream_data.stream_id = -1;
-  ud.stream_data.flags = NGTCP2_STREAM_DATA_FLAG_NONE;
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  for (i = 1; i <= 2; ++i) {
+    fr.new_connection_id.seq = i;
+    ngtcp2_cid_init(&fr.new_connection_id.cid, raw_cid, sizeof(raw_cid));
+    fr.new_connection_id.cid.data[1] = (uint8_t)i;
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(0 == ud.stream_data.stream_id);
-  CU_ASSERT((ud.stream_data.flags & NGTCP2_STREAM_DATA_FLAG_FIN) != 0);
+    pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid,
+                                    pkt_num++, &fr, conn->pktns.crypto.rx.ckm);
+    rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen,
+                              ++t);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+    CU_ASSERT(0 == rv);
+  }
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT((size_t)spktlen < sizeof(buf));
+  conn->cstat.min_rtt = 30 * NGTCP2_MILLISECONDS;
+  conn->cstat.cwnd = 200000;
 
-  frs[0].type = NGTCP2_FRAME_ACK;
-  frs[0].ack.largest_ack = 0;
-  frs[0].ack.ack_delay = 0;
-  frs[0].ack.first_ack_blklen = 0;
-  frs[0].ack.num_blks = 0;
+  rv = ngtcp2_conn_initiate_immediate_migration(conn, &new_path.path, ++t);
 
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 1,
-                     conn->pktns.crypto.tx.ckm);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_CC_RESUME_PHASE_NONE == conn->cc_resume.phase);
+  CU_ASSERT(1 == conn->cc_resume.npaths);
+  CU_ASSERT(ngtcp2_path_eq(&null_path.path,
+                           &conn->cc_resume.paths[0].ps.path));
+  CU_ASSERT(30 * NGTCP2_MILLISECONDS ==
+            conn->cc_resume.paths[0].params.min_rtt);
+  CU_ASSERT(200000 == conn->cc_resume.paths[0].params.cwnd);
+  CU_ASSERT(conn->cstat.cwnd < 200000);
 
-  ud.stream_close.flags = NGTCP2_STREAM_CLOSE_FLAG_NONE;
-  ud.stream_close.stream_id = -1;
-  ud.stream_close.app_error_code = 0;
+  conn->cstat.min_rtt = 80 * NGTCP2_MILLISECONDS;
+  conn->cstat.cwnd = 100000;
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_conn_initiate_immediate_migration(conn, &null_path.path, ++t);
 
   CU_ASSERT(0 == rv);
-
-  CU_ASSERT(NGTCP2_STREAM_CLOSE_FLAG_APP_ERROR_CODE_SET &
-            ud.stream_close.flags);
-  CU_ASSERT(0 == ud.stream_close.stream_id);
-  CU_ASSERT(NGTCP2_APP_ERR01 == ud.stream_close.app_error_code);
+  CU_ASSERT(NGTCP2_CC_RESUME_PHASE_RECONNAISSANCE == conn->cc_resume.phase);
+  CU_ASSERT(30 * NGTCP2_MILLISECONDS == conn->cc_resume.params.min_rtt);
+  CU_ASSERT(200000 == conn->cc_resume.params.cwnd);
+  CU_ASSERT(2 == conn->cc_resume.npaths);
+  CU_ASSERT(ngtcp2_path_eq(&new_path.path, &conn->cc_resume.paths[1].ps.path));
+  CU_ASSERT(80 * NGTCP2_MILLISECONDS ==
+            conn->cc_resume.paths[1].params.min_rtt);
 
   ngtcp2_conn_del(conn);
+}
 
-  /* Client calls ngtcp2_conn_shutdown_stream, and before sending
-     STOP_SENDING, it receives STREAM with fin bit set. */
-  pkt_num = 0;
-
-  setup_default_client(&conn);
-  conn->callbacks.stream_close = stream_close;
-  conn->user_data = &ud;
-
-  rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
-
-  CU_ASSERT(0 == rv);
-
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                                     NGTCP2_WRITE_STREAM_FLAG_FIN, stream_id,
-                                     null_data, 1, ++t);
+void test_ngtcp2_encode_cc_resume_params(void) {
+  ngtcp2_cc_resume_params params, nparams;
+  uint8_t buf[NGTCP2_MAX_CC_RESUME_PARAMSLEN];
+  ngtcp2_ssize nwrite;
+  int rv;
 
-  CU_ASSERT(spktlen > 0);
+  params.min_rtt = 25 * NGTCP2_MILLISECONDS;
+  params.max_bw = 12500000;
+  params.cwnd = 1000000;
 
-  frs[0].type = NGTCP2_FRAME_ACK;
-  frs[0].ack.largest_ack = conn->pktns.tx.last_pkt_num;
-  frs[0].ack.ack_delay = 0;
-  frs[0].ack.first_ack_blklen = 0;
-  frs[0].ack.num_blks = 0;
+  nwrite = ngtcp2_encode_cc_resume_params(buf, sizeof(buf), &params);
 
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 1,
-                     conn->pktns.crypto.tx.ckm);
+  CU_ASSERT(1 + 4 + 4 + 4 == nwrite);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_decode_cc_resume_params(&nparams, buf, (size_t)nwrite);
 
   CU_ASSERT(0 == rv);
+  CU_ASSERT(params.min_rtt == nparams.min_rtt);
+  CU_ASSERT(params.max_bw == nparams.max_bw);
+  CU_ASSERT(params.cwnd == nparams.cwnd);
 
-  rv = ngtcp2_conn_shutdown_stream(conn, stream_id, NGTCP2_APP_ERR01);
+  /* Truncated */
+  rv = ngtcp2_decode_cc_resume_params(&nparams, buf, (size_t)nwrite - 1);
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
 
-  frs[0].type = NGTCP2_FRAME_STREAM;
-  frs[0].stream.flags = 0;
-  frs[0].stream.fin = 1;
-  frs[0].stream.stream_id = stream_id;
-  frs[0].stream.offset = 0;
-  frs[0].stream.datacnt = 1;
-  frs[0].stream.data[0].len = 97;
-  frs[0].stream.data[0].base = null_data;
+  /* Unknown version */
+  buf[0] = 0xff;
+  rv = ngtcp2_decode_cc_resume_params(&nparams, buf, (size_t)nwrite);
 
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 1,
-                     conn->pktns.crypto.tx.ckm);
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
 
-  ud.stream_close.flags = NGTCP2_STREAM_CLOSE_FLAG_NONE;
-  ud.stream_close.stream_id = -1;
-  ud.stream_close.app_error_code = 0;
+  /* The values which do not fit in a varint are capped. */
+  params.min_rtt = UINT64_MAX;
+  params.max_bw = UINT64_MAX;
+  params.cwnd = UINT64_MAX;
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  nwrite = ngtcp2_encode_cc_resume_params(buf, sizeof(buf), &params);
+
+  CU_ASSERT(NGTCP2_MAX_CC_RESUME_PARAMSLEN == nwrite);
+
+  rv = ngtcp2_decode_cc_resume_params(&nparams, buf, (size_t)nwrite);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NGTCP2_STREAM_CLOSE_FLAG_APP_ERROR_CODE_SET &
-            ud.stream_close.flags);
-  CU_ASSERT(stream_id == ud.stream_close.stream_id);
-  CU_ASSERT(NGTCP2_APP_ERR01 == ud.stream_close.app_error_code);
+  CU_ASSERT(NGTCP2_MAX_VARINT == nparams.cwnd);
 
-  ngtcp2_conn_del(conn);
+  nwrite = ngtcp2_encode_cc_resume_params(buf, sizeof(buf) - 1, &params);
 
-  /* Client sends STREAM fin and then RESET_STREAM.  It receives ACK
-     for the STREAM frame, then response fin. No ACK for
-     RESET_STREAM. */
-  pkt_num = 0;
+  CU_ASSERT(NGTCP2_ERR_NOBUF == nwrite);
+}
+
+void test_ngtcp2_conn_spurious_loss(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[2048];
+  ngtcp2_ssize spktlen;
+  size_t pktlen;
+  ngtcp2_frame fr;
+  int64_t stream_id;
+  int64_t pkt_num = 0;
+  ngtcp2_tstamp t = 0;
+  uint64_t cwnd;
+  size_t i;
+  int rv;
 
   setup_default_client(&conn);
-  conn->callbacks.stream_close = stream_close;
-  conn->user_data = &ud;
 
   rv = ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
   CU_ASSERT(0 == rv);
 
-  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                                     NGTCP2_WRITE_STREAM_FLAG_FIN, stream_id,
-                                     null_data, 1, ++t);
+  for (i = 0; i < 5; ++i) {
+    spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                       NULL, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                       stream_id, null_data, 100, t);
 
-  CU_ASSERT(spktlen > 0);
+    CU_ASSERT(0 < spktlen);
 
-  rv = ngtcp2_conn_shutdown_stream_write(conn, stream_id, NGTCP2_APP_ERR01);
+    t += NGTCP2_MILLISECONDS;
+  }
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(4 == conn->pktns.tx.last_pkt_num);
+  CU_ASSERT(NGTCP2_PKT_THRESHOLD == conn->pktns.rtb.reorder.pkt_thres);
+  CU_ASSERT(0 == conn->pktns.rtb.reorder.wnd_mult);
 
-  frs[0].type = NGTCP2_FRAME_STREAM;
-  frs[0].stream.flags = 0;
-  frs[0].stream.fin = 1;
-  frs[0].stream.stream_id = stream_id;
-  frs[0].stream.offset = 0;
-  frs[0].stream.datacnt = 0;
+  cwnd = conn->cstat.cwnd;
 
-  frs[1].type = NGTCP2_FRAME_ACK;
-  frs[1].ack.largest_ack = conn->pktns.tx.last_pkt_num;
-  frs[1].ack.ack_delay = 0;
-  frs[1].ack.first_ack_blklen = 0;
-  frs[1].ack.num_blks = 0;
+  /* Packet 0 is declared lost by packet threshold. */
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = 4;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 3;
+  fr.ack.num_blks = 0;
 
-  spktlen =
-      ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
-                               NGTCP2_WRITE_STREAM_FLAG_NONE, -1, NULL, 0, ++t);
+  t += 10 * NGTCP2_MILLISECONDS;
 
-  CU_ASSERT(spktlen > 0);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, pkt_num++,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, t);
 
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs, 2,
-                     conn->pktns.crypto.tx.ckm);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == conn->pktns.rtb.num_lost_pkts);
+  CU_ASSERT(cwnd > conn->cstat.cwnd);
+  CU_ASSERT(UINT64_MAX != conn->cstat.congestion_recovery_start_ts);
+  CU_ASSERT(0 == conn->cstat.spurious_loss_count);
 
-  ud.stream_close.flags = NGTCP2_STREAM_CLOSE_FLAG_NONE;
-  ud.stream_close.stream_id = -1;
-  ud.stream_close.app_error_code = 0;
+  /* Packet 0 arrives late.  The loss was spurious. */
+  fr.ack.first_ack_blklen = 4;
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  t += NGTCP2_MILLISECONDS;
+
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, pkt_num++,
+                                  &fr, conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, t);
 
   CU_ASSERT(0 == rv);
-  CU_ASSERT(NGTCP2_STREAM_CLOSE_FLAG_APP_ERROR_CODE_SET &
-            ud.stream_close.flags);
-  CU_ASSERT(stream_id == ud.stream_close.stream_id);
-  CU_ASSERT(NGTCP2_APP_ERR01 == ud.stream_close.app_error_code);
+  CU_ASSERT(0 == conn->pktns.rtb.num_lost_pkts);
+  CU_ASSERT(5 == conn->pktns.rtb.reorder.pkt_thres);
+  CU_ASSERT(1 == conn->pktns.rtb.reorder.wnd_mult);
+  CU_ASSERT(NGTCP2_REO_WND_PERSIST == conn->pktns.rtb.reorder.wnd_persist);
+  /* The congestion window is restored to the value just before the
+     loss was detected, which includes the growth by packets 1-4. */
+  CU_ASSERT(cwnd < conn->cstat.cwnd);
+  CU_ASSERT(UINT64_MAX == conn->cstat.congestion_recovery_start_ts);
+  CU_ASSERT(1 == conn->cstat.spurious_loss_count);
+  CU_ASSERT(1 == conn->cstat.spurious_congestion_count);
+
+  /* The learned tolerance is forgotten when the path changes. */
+  ngtcp2_rtb_reset_cc_state(&conn->pktns.rtb,
+                            conn->pktns.tx.last_pkt_num + 1);
+
+  CU_ASSERT(NGTCP2_PKT_THRESHOLD == conn->pktns.rtb.reorder.pkt_thres);
+  CU_ASSERT(0 == conn->pktns.rtb.reorder.wnd_mult);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_buffer_pkt(void) {
-  ngtcp2_conn *conn;
-  int rv;
-  uint8_t buf[2048];
-  ngtcp2_frame fr;
-  ngtcp2_frame frs[2];
-  size_t pktlen, in_pktlen;
-  int64_t pkt_num = 0;
-  ngtcp2_tstamp t = 0;
-  ngtcp2_ssize spktlen;
-  ngtcp2_crypto_aead_ctx aead_ctx = {0};
-  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
-  ngtcp2_ksl_it it;
-  ngtcp2_pkt_chain *pc;
+typedef struct failmalloc {
+  size_t nmalloc;
+  size_t fail_start;
+} failmalloc;
 
-  /* Server should buffer Short packet if it does not complete
-     handshake even if it has application tx key. */
-  setup_handshake_server(&conn);
+static void *failmalloc_malloc(size_t size, void *user_data) {
+  failmalloc *mc = user_data;
 
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 1193;
-  fr.crypto.data[0].base = null_data;
+  if (mc->fail_start <= ++mc->nmalloc) {
+    return NULL;
+  }
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
-      ngtcp2_conn_get_dcid(conn), pkt_num++, NGTCP2_PROTO_VER_V1, &fr,
-      &null_ckm);
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  return malloc(size);
+}
 
-  CU_ASSERT(0 == rv);
+static void failmalloc_free(void *ptr, void *user_data) {
+  (void)user_data;
 
-  rv = ngtcp2_conn_install_tx_key(conn, null_secret, sizeof(null_secret),
-                                  &aead_ctx, null_iv, sizeof(null_iv), &hp_ctx);
+  free(ptr);
+}
 
-  assert(0 == rv);
+static void *failmalloc_calloc(size_t nmemb, size_t size, void *user_data) {
+  failmalloc *mc = user_data;
 
-  rv = ngtcp2_conn_install_rx_key(conn, null_secret, sizeof(null_secret),
-                                  &aead_ctx, null_iv, sizeof(null_iv), &hp_ctx);
+  if (mc->fail_start <= ++mc->nmalloc) {
+    return NULL;
+  }
 
-  assert(0 == rv);
+  return calloc(nmemb, size);
+}
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+static void *failmalloc_realloc(void *ptr, size_t size, void *user_data) {
+  failmalloc *mc = user_data;
 
-  CU_ASSERT(spktlen > 0);
+  if (mc->fail_start <= ++mc->nmalloc) {
+    return NULL;
+  }
 
-  fr.type = NGTCP2_FRAME_PING;
+  return realloc(ptr, size);
+}
 
-  in_pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
-      ngtcp2_conn_get_dcid(conn), pkt_num++, NGTCP2_PROTO_VER_V1, &fr,
-      &null_ckm);
+void test_ngtcp2_conn_new_failmalloc(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_callbacks cb;
+  ngtcp2_settings settings;
+  ngtcp2_transport_params params;
+  failmalloc mc;
+  ngtcp2_mem mem = {
+      &mc,
+      failmalloc_malloc,
+      failmalloc_free,
+      failmalloc_calloc,
+      failmalloc_realloc,
+  };
+  ngtcp2_vec token = {
+      (uint8_t *)"token",
+      sizeof("token") - 1,
+  };
+  uint32_t preferred_versions[] = {
+      NGTCP2_PROTO_VER_V1,
+      NGTCP2_PROTO_VER_V2_DRAFT,
+  };
+  uint32_t other_versions[] = {
+      NGTCP2_PROTO_VER_V2_DRAFT,
+      NGTCP2_PROTO_VER_V1,
+      0x5a9aeaca,
+  };
+  ngtcp2_cid dcid, scid;
+  int rv;
+  size_t i;
+  size_t nmalloc;
 
-  frs[0].type = NGTCP2_FRAME_PING;
-  frs[1].type = NGTCP2_FRAME_PADDING;
-  frs[1].padding.len = 1200;
+  dcid_init(&dcid);
+  scid_init(&scid);
 
-  pktlen = write_pkt(buf + in_pktlen, sizeof(buf) - in_pktlen, &conn->oscid,
-                     pkt_num++, frs, 2, &null_ckm);
+  ngtcp2_settings_default(&settings);
+  ngtcp2_transport_params_default(&params);
 
-  CU_ASSERT(!conn->pktns.rx.buffed_pkts);
+  settings.qlog.write = qlog_write;
+  settings.token = token;
+  settings.preferred_versions = preferred_versions;
+  settings.preferred_versionslen = arraylen(preferred_versions);
+  settings.other_versions = other_versions;
+  settings.other_versionslen = arraylen(other_versions);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf,
-                            in_pktlen + pktlen, ++t);
+  /* server */
+  server_default_callbacks(&cb);
 
-  CU_ASSERT(0 == rv);
+  mc.nmalloc = 0;
+  mc.fail_start = SIZE_MAX;
 
-  pc = conn->pktns.rx.buffed_pkts;
+  rv = ngtcp2_conn_server_new(&conn, &dcid, &scid, &null_path.path,
+                              NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
+                              &mem, NULL);
 
-  CU_ASSERT(pktlen == pc->pktlen);
-  CU_ASSERT(in_pktlen + pktlen == pc->dgramlen);
+  CU_ASSERT(0 == rv);
 
-  it = ngtcp2_acktr_get(&conn->pktns.acktr);
+  ngtcp2_conn_del(conn);
 
-  CU_ASSERT(ngtcp2_ksl_it_end(&it));
+  nmalloc = mc.nmalloc;
 
-  ngtcp2_conn_del(conn);
-}
+  for (i = 0; i <= nmalloc; ++i) {
+    mc.nmalloc = 0;
+    mc.fail_start = i;
 
-void test_ngtcp2_conn_handshake_timeout(void) {
-  ngtcp2_conn *conn;
-  int rv;
+    rv = ngtcp2_conn_server_new(&conn, &dcid, &scid, &null_path.path,
+                                NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
+                                &mem, NULL);
 
-  /* handshake has just timed out */
-  setup_handshake_server(&conn);
+    CU_ASSERT(NGTCP2_ERR_NOMEM == rv);
+  }
 
-  rv = ngtcp2_conn_handle_expiry(conn,
-                                 conn->local.settings.initial_ts +
-                                     conn->local.settings.handshake_timeout);
+  mc.nmalloc = 0;
+  mc.fail_start = nmalloc + 1;
+
+  rv = ngtcp2_conn_server_new(&conn, &dcid, &scid, &null_path.path,
+                              NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
+                              &mem, NULL);
 
-  CU_ASSERT(NGTCP2_ERR_HANDSHAKE_TIMEOUT == rv);
+  CU_ASSERT(0 == rv);
 
   ngtcp2_conn_del(conn);
 
-  /* handshake is still in progress */
-  setup_handshake_server(&conn);
+  /* client */
+  client_default_callbacks(&cb);
 
-  rv = ngtcp2_conn_handle_expiry(
-      conn, conn->local.settings.initial_ts +
-                conn->local.settings.handshake_timeout - 1);
+  mc.nmalloc = 0;
+  mc.fail_start = SIZE_MAX;
+
+  rv = ngtcp2_conn_client_new(&conn, &dcid, &scid, &null_path.path,
+                              NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
+                              &mem, NULL);
 
   CU_ASSERT(0 == rv);
 
   ngtcp2_conn_del(conn);
 
-  /* handshake timeout should be ignored after handshake has
-     completed. */
-  setup_default_server(&conn);
+  nmalloc = mc.nmalloc;
 
-  rv = ngtcp2_conn_handle_expiry(conn,
-                                 conn->local.settings.initial_ts +
-                                     conn->local.settings.handshake_timeout);
+  for (i = 0; i <= nmalloc; ++i) {
+    mc.nmalloc = 0;
+    mc.fail_start = i;
+
+    rv = ngtcp2_conn_client_new(&conn, &dcid, &scid, &null_path.path,
+                                NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
+                                &mem, NULL);
+
+    CU_ASSERT(NGTCP2_ERR_NOMEM == rv);
+  }
+
+  mc.nmalloc = 0;
+  mc.fail_start = nmalloc + 1;
+
+  rv = ngtcp2_conn_client_new(&conn, &dcid, &scid, &null_path.path,
+                              NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
+                              &mem, NULL);
 
   CU_ASSERT(0 == rv);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_get_connection_close_error(void) {
-  ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  ngtcp2_frame frs[2];
+void test_ngtcp2_accept(void) {
   size_t pktlen;
-  uint8_t reason[2048];
-  ngtcp2_tstamp t = 0;
-  int64_t pkt_num = 0;
+  uint8_t buf[2048];
+  ngtcp2_cid dcid, scid;
+  ngtcp2_frame fr;
   int rv;
-  ngtcp2_connection_close_error ccerr;
-
-  memset(reason, 'a', sizeof(reason));
+  ngtcp2_pkt_hd hd;
 
-  setup_default_server(&conn);
+  dcid_init(&dcid);
+  scid_init(&scid);
 
-  /* Record the last error. */
-  frs[0].type = NGTCP2_FRAME_CONNECTION_CLOSE_APP;
-  frs[0].connection_close.error_code = 1;
-  frs[0].connection_close.frame_type = 99;
-  frs[0].connection_close.reasonlen = 10;
-  frs[0].connection_close.reason = reason;
+  /* Initial packet */
+  memset(&hd, 0, sizeof(hd));
 
-  frs[1].type = NGTCP2_FRAME_CONNECTION_CLOSE;
-  frs[1].connection_close.error_code = NGTCP2_PROTOCOL_VIOLATION;
-  frs[1].connection_close.frame_type = 1000000007;
-  frs[1].connection_close.reasonlen =
-      NGTCP2_CONNECTION_CLOSE_ERROR_MAX_REASONLEN + 1;
-  frs[1].connection_close.reason = reason;
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 1200;
+  fr.crypto.data[0].base = null_data;
 
-  pktlen = write_pkt(buf, sizeof(buf), &conn->oscid, ++pkt_num, frs,
-                     arraylen(frs), conn->pktns.crypto.rx.ckm);
+  pktlen = write_single_frame_initial_pkt(buf, sizeof(buf), &dcid, &scid, 0,
+                                          NGTCP2_PROTO_VER_V1, &fr, NULL, 0,
+                                          &null_ckm);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  CU_ASSERT(pktlen >= 1200);
 
-  CU_ASSERT(NGTCP2_ERR_DRAINING == rv);
+  rv = ngtcp2_accept(&hd, buf, pktlen);
 
-  ngtcp2_conn_get_connection_close_error(conn, &ccerr);
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(ngtcp2_cid_eq(&dcid, &hd.dcid));
+  CU_ASSERT(ngtcp2_cid_eq(&scid, &hd.scid));
+  CU_ASSERT(0 == hd.token.len);
+  CU_ASSERT(hd.len > 0);
+  CU_ASSERT(NGTCP2_PROTO_VER_V1 == hd.version);
+  CU_ASSERT(NGTCP2_PKT_INITIAL == hd.type);
+  CU_ASSERT(hd.flags & NGTCP2_PKT_FLAG_LONG_FORM);
 
-  CU_ASSERT(NGTCP2_PROTOCOL_VIOLATION == ccerr.error_code);
-  CU_ASSERT(NGTCP2_CONNECTION_CLOSE_ERROR_CODE_TYPE_TRANSPORT == ccerr.type);
-  CU_ASSERT(1000000007 == ccerr.frame_type);
-  CU_ASSERT(0 == memcmp(reason, ccerr.reason, ccerr.reasonlen));
-  CU_ASSERT(NGTCP2_CONNECTION_CLOSE_ERROR_MAX_REASONLEN == ccerr.reasonlen);
+  /* 0RTT packet */
+  memset(&hd, 0, sizeof(hd));
 
-  ngtcp2_conn_del(conn);
-}
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.flags = 0;
+  fr.stream.stream_id = 0;
+  fr.stream.fin = 0;
+  fr.stream.offset = 0;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 1200;
+  fr.stream.data[0].base = null_data;
 
-void test_ngtcp2_conn_version_negotiation(void) {
-  ngtcp2_conn *conn;
-  uint8_t buf[2048];
-  ngtcp2_frame fr;
-  ngtcp2_tstamp t = 0;
-  ngtcp2_ssize spktlen;
-  int64_t pkt_num = 0;
-  size_t pktlen;
-  int rv;
-  ngtcp2_transport_params remote_params;
-  uint8_t other_versions[sizeof(uint32_t) * 2];
+  pktlen = write_single_frame_0rtt_pkt(buf, sizeof(buf), &dcid, &scid, 1,
+                                       NGTCP2_PROTO_VER_V1, &fr, &null_ckm);
 
-  ngtcp2_put_uint32be(&other_versions[0], NGTCP2_PROTO_VER_V1);
-  ngtcp2_put_uint32be(&other_versions[4], NGTCP2_PROTO_VER_V2_DRAFT);
+  CU_ASSERT(pktlen >= 1200);
 
-  /* Client sees the change version in Initial packet which contains
-     CRYPTO frame.  It generates new Initial keys and sets negotiated
-     version. */
-  setup_handshake_client(&conn);
+  rv = ngtcp2_accept(&hd, buf, pktlen);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  CU_ASSERT(NGTCP2_ERR_RETRY == rv);
+  CU_ASSERT(ngtcp2_cid_eq(&dcid, &hd.dcid));
+  CU_ASSERT(ngtcp2_cid_eq(&scid, &hd.scid));
+  CU_ASSERT(0 == hd.token.len);
+  CU_ASSERT(hd.len > 0);
+  CU_ASSERT(NGTCP2_PROTO_VER_V1 == hd.version);
+  CU_ASSERT(NGTCP2_PKT_0RTT == hd.type);
+  CU_ASSERT(hd.flags & NGTCP2_PKT_FLAG_LONG_FORM);
 
-  CU_ASSERT(spktlen > 0);
+  /* Unknown version */
+  memset(&hd, 0, sizeof(hd));
 
   fr.type = NGTCP2_FRAME_CRYPTO;
   fr.crypto.offset = 0;
   fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 133;
+  fr.crypto.data[0].len = 1200;
   fr.crypto.data[0].base = null_data;
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
-      ngtcp2_conn_get_dcid(conn), pkt_num++, NGTCP2_PROTO_VER_V2_DRAFT, &fr,
-      &null_ckm);
+  pktlen =
+      write_single_frame_handshake_pkt(buf, sizeof(buf), NGTCP2_PKT_INITIAL,
+                                       &dcid, &scid, 0, 0x2, &fr, &null_ckm);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  CU_ASSERT(pktlen >= 1200);
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NGTCP2_PROTO_VER_V2_DRAFT == conn->negotiated_version);
-  CU_ASSERT(NGTCP2_PROTO_VER_V2_DRAFT == conn->vneg.version);
-  CU_ASSERT(conn->vneg.rx.ckm != NULL);
-  CU_ASSERT(conn->vneg.tx.ckm != NULL);
+  rv = ngtcp2_accept(&hd, buf, pktlen);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  /* Unknown version should be filtered out by earlier call of
+     ngtcp2_pkt_decode_version_cid, that is, only supported versioned
+     packet should be passed to ngtcp2_accept. */
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
 
-  CU_ASSERT(spktlen > 0);
-  CU_ASSERT(NGTCP2_PROTO_VER_V2_DRAFT == ngtcp2_get_uint32(&buf[1]));
+  /* Unknown version and the UDP payload size is less than
+     NGTCP2_MAX_UDP_PAYLOAD_SIZE. */
+  memset(&hd, 0, sizeof(hd));
 
-  ngtcp2_conn_del(conn);
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 1127;
+  fr.crypto.data[0].base = null_data;
 
-  /* Client receives Initial packet which does not change version and
-     does not contain CRYPTO frame.  It leaves negotiated version
-     unchanged. */
-  setup_handshake_client(&conn);
+  pktlen =
+      write_single_frame_handshake_pkt(buf, sizeof(buf), NGTCP2_PKT_INITIAL,
+                                       &dcid, &scid, 0, 0x2, &fr, &null_ckm);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  CU_ASSERT(1199 == pktlen);
 
-  CU_ASSERT(spktlen > 0);
+  rv = ngtcp2_accept(&hd, buf, pktlen);
 
-  fr.type = NGTCP2_FRAME_PADDING;
-  fr.padding.len = 1;
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
-      ngtcp2_conn_get_dcid(conn), pkt_num++, NGTCP2_PROTO_VER_V1, &fr,
-      &null_ckm);
+  /* Short packet */
+  memset(&hd, 0, sizeof(hd));
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  fr.type = NGTCP2_FRAME_CRYPTO;
+  fr.crypto.offset = 0;
+  fr.crypto.datacnt = 1;
+  fr.crypto.data[0].len = 1200;
+  fr.crypto.data[0].base = null_data;
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(0 == conn->negotiated_version);
-  CU_ASSERT(0 == conn->vneg.version);
-  CU_ASSERT(conn->vneg.rx.ckm == NULL);
-  CU_ASSERT(conn->vneg.tx.ckm == NULL);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &dcid, 0, &fr, &null_ckm);
 
-  ngtcp2_conn_del(conn);
+  CU_ASSERT(pktlen >= 1200);
 
-  /* Server sees client supports QUIC v2.  It chooses QUIC v2 as the
-     negotiated version, and generates new Initial keys. */
-  setup_handshake_server(&conn);
+  rv = ngtcp2_accept(&hd, buf, pktlen);
 
-  conn->callbacks.recv_client_initial =
-      recv_client_initial_no_remote_transport_params;
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
 
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 1233;
-  fr.crypto.data[0].base = null_data;
+  /* Unable to decode packet header */
+  memset(&hd, 0, sizeof(hd));
 
-  pktlen = write_single_frame_handshake_pkt(
-      buf, sizeof(buf), NGTCP2_PKT_INITIAL, &conn->oscid,
-      ngtcp2_conn_get_dcid(conn), pkt_num++, NGTCP2_PROTO_VER_V1, &fr,
-      &null_ckm);
+  memset(buf, 0, 4);
+  buf[0] = NGTCP2_HEADER_FORM_BIT;
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  rv = ngtcp2_accept(&hd, buf, 4);
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
+}
+
+void test_ngtcp2_select_version(void) {
+  CU_ASSERT(0 == ngtcp2_select_version(NULL, 0, NULL, 0));
+
+  {
+    uint32_t preferred_versions[] = {NGTCP2_PROTO_VER_V1,
+                                     NGTCP2_PROTO_VER_V2_DRAFT};
+    uint32_t offered_versions[] = {0x00000004, 0x00000003,
+                                   NGTCP2_PROTO_VER_V2_DRAFT};
+
+    CU_ASSERT(
+        NGTCP2_PROTO_VER_V2_DRAFT ==
+        ngtcp2_select_version(preferred_versions, arraylen(preferred_versions),
+                              offered_versions, arraylen(offered_versions)));
+  }
+
+  {
+    uint32_t preferred_versions[] = {NGTCP2_PROTO_VER_V1,
+                                     NGTCP2_PROTO_VER_V2_DRAFT};
+    uint32_t offered_versions[] = {0x00000004, 0x00000003};
 
-  ngtcp2_transport_params_default(&remote_params);
-  ngtcp2_cid_init(&remote_params.initial_scid, conn->dcid.current.cid.data,
-                  conn->dcid.current.cid.datalen);
-  remote_params.version_info_present = 1;
-  remote_params.version_info.chosen_version = NGTCP2_PROTO_VER_V1;
-  remote_params.version_info.other_versions = other_versions;
-  remote_params.version_info.other_versionslen = sizeof(other_versions);
+    CU_ASSERT(0 == ngtcp2_select_version(
+                       preferred_versions, arraylen(preferred_versions),
+                       offered_versions, arraylen(offered_versions)));
+  }
+}
 
-  rv = ngtcp2_conn_set_remote_transport_params(conn, &remote_params);
+void test_ngtcp2_pkt_write_connection_close(void) {
+  ngtcp2_ssize spktlen;
+  uint8_t buf[1200];
+  ngtcp2_cid dcid, scid;
+  ngtcp2_crypto_aead aead = {0, NGTCP2_INITIAL_AEAD_OVERHEAD};
+  ngtcp2_crypto_cipher hp_mask = {0};
+  ngtcp2_crypto_aead_ctx aead_ctx = {0};
+  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(NGTCP2_PROTO_VER_V2_DRAFT == conn->negotiated_version);
-  CU_ASSERT(NGTCP2_PROTO_VER_V2_DRAFT == conn->vneg.version);
-  CU_ASSERT(conn->vneg.rx.ckm != NULL);
-  CU_ASSERT(conn->vneg.tx.ckm != NULL);
+  dcid_init(&dcid);
+  scid_init(&scid);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  spktlen = ngtcp2_pkt_write_connection_close(
+      buf, sizeof(buf), NGTCP2_PROTO_VER_V1, &dcid, &scid, NGTCP2_INVALID_TOKEN,
+      (const uint8_t *)"foo", 3, null_encrypt, &aead, &aead_ctx, null_iv,
+      null_hp_mask, &hp_mask, &hp_ctx);
 
   CU_ASSERT(spktlen > 0);
-  CU_ASSERT(NGTCP2_PROTO_VER_V2_DRAFT == ngtcp2_get_uint32(&buf[1]));
 
-  ngtcp2_conn_del(conn);
+  spktlen = ngtcp2_pkt_write_connection_close(
+      buf, 16, NGTCP2_PROTO_VER_V1, &dcid, &scid, NGTCP2_INVALID_TOKEN, NULL, 0,
+      null_encrypt, &aead, &aead_ctx, null_iv, null_hp_mask, &hp_mask, &hp_ctx);
+
+  CU_ASSERT(NGTCP2_ERR_NOBUF == spktlen);
 }
 
-void test_ngtcp2_conn_server_negotiate_version(void) {
+void test_ngtcp2_conn_get_expiry(void) {
   ngtcp2_conn *conn;
-  ngtcp2_version_info version_info = {0};
-  uint8_t client_other_versions[sizeof(uint32_t) * 2];
+  uint8_t buf[1200];
+  ngtcp2_tstamp t = 1000 * NGTCP2_MILLISECONDS;
+  ngtcp2_tstamp expiry;
+  ngtcp2_ssize spktlen;
+  ngtcp2_pkt_info pi;
+  int64_t stream_id;
+  int rv;
 
-  setup_handshake_server(&conn);
+  setup_default_client(&conn);
 
-  version_info.chosen_version = conn->client_chosen_version;
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
-  /* Empty version_info.other_versions */
-  version_info.other_versions = NULL;
-  version_info.other_versionslen = 0;
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 100, t);
 
-  CU_ASSERT(conn->client_chosen_version ==
-            ngtcp2_conn_server_negotiate_version(conn, &version_info));
+  CU_ASSERT(spktlen > 0);
 
-  /* version_info.other_versions and preferred_versions do not share
-     any version. */
-  ngtcp2_put_uint32be(&client_other_versions[0], 0xff000001);
-  ngtcp2_put_uint32be(&client_other_versions[4], 0xff000002);
+  expiry = ngtcp2_conn_get_expiry(conn);
 
-  version_info.other_versions = client_other_versions;
-  version_info.other_versionslen = sizeof(uint32_t) * 2;
+  CU_ASSERT(conn->cstat.loss_detection_timer == expiry);
+  CU_ASSERT(conn->flags & NGTCP2_CONN_FLAG_EXPIRY_VALID);
+  CU_ASSERT(expiry == ngtcp2_conn_get_expiry(conn));
 
-  CU_ASSERT(conn->client_chosen_version ==
-            ngtcp2_conn_server_negotiate_version(conn, &version_info));
+  /* Changing a timer discards the cached expiry. */
+  ngtcp2_conn_set_keep_alive_timeout(conn, NGTCP2_MILLISECONDS);
 
-  /* version_info.other_versions and preferred_versions share the
-     version. */
-  ngtcp2_put_uint32be(&client_other_versions[0], 0xff000001);
-  ngtcp2_put_uint32be(&client_other_versions[4], NGTCP2_PROTO_VER_V2_DRAFT);
+  CU_ASSERT(!(conn->flags & NGTCP2_CONN_FLAG_EXPIRY_VALID));
+  CU_ASSERT(t + NGTCP2_MILLISECONDS == ngtcp2_conn_get_expiry(conn));
 
-  version_info.other_versions = client_other_versions;
-  version_info.other_versionslen = sizeof(uint32_t) * 2;
+  rv = ngtcp2_conn_handle_expiry(conn, t + NGTCP2_MILLISECONDS);
 
-  CU_ASSERT(NGTCP2_PROTO_VER_V2_DRAFT ==
-            ngtcp2_conn_server_negotiate_version(conn, &version_info));
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(conn->flags & NGTCP2_CONN_FLAG_KEEP_ALIVE_CANCELLED);
+  CU_ASSERT(expiry == ngtcp2_conn_get_expiry(conn));
 
   ngtcp2_conn_del(conn);
+}
 
-  /* Without preferred_versions */
-  setup_handshake_server(&conn);
-
-  ngtcp2_mem_free(conn->mem, conn->vneg.preferred_versions);
-  conn->vneg.preferred_versions = NULL;
-  conn->vneg.preferred_versionslen = 0;
+void test_ngtcp2_conn_perf_stat(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[1200];
+  ngtcp2_ssize spktlen;
+  size_t pktlen;
+  ngtcp2_pkt_info pi;
+  ngtcp2_frame fr;
+  int64_t stream_id;
+  ngtcp2_perf_stat perf_stat;
+  int rv;
 
-  ngtcp2_put_uint32be(&client_other_versions[0], 0xff000001);
-  ngtcp2_put_uint32be(&client_other_versions[4], NGTCP2_PROTO_VER_V2_DRAFT);
+  setup_default_client(&conn);
+  ngtcp2_perf_init(&conn->perf, 1);
 
-  version_info.other_versions = client_other_versions;
-  version_info.other_versionslen = sizeof(uint32_t) * 2;
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
 
-  CU_ASSERT(conn->client_chosen_version ==
-            ngtcp2_conn_server_negotiate_version(conn, &version_info));
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, &pi, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 100, 1);
 
-  ngtcp2_conn_del(conn);
+  CU_ASSERT(spktlen > 0);
 
-  /* original version is the most preferred version */
-  setup_handshake_server(&conn);
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
 
-  conn->vneg.preferred_versions[0] = NGTCP2_PROTO_VER_V1;
-  conn->vneg.preferred_versions[1] = NGTCP2_PROTO_VER_V2_DRAFT;
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 0, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, 2);
 
-  ngtcp2_put_uint32be(&client_other_versions[0], NGTCP2_PROTO_VER_V2_DRAFT);
-  ngtcp2_put_uint32be(&client_other_versions[4], NGTCP2_PROTO_VER_V1);
+  CU_ASSERT(0 == rv);
 
-  version_info.other_versions = client_other_versions;
-  version_info.other_versionslen = sizeof(uint32_t) * 2;
+  ngtcp2_conn_get_perf_stat(conn, &perf_stat);
 
-  CU_ASSERT(conn->client_chosen_version ==
-            ngtcp2_conn_server_negotiate_version(conn, &version_info));
+#ifdef PERFSTAT
+  CU_ASSERT(perf_stat.decrypt > 0);
+  CU_ASSERT(perf_stat.frame_decode > 0);
+  CU_ASSERT(perf_stat.ack > 0);
+  CU_ASSERT(perf_stat.cc > 0);
+  CU_ASSERT(perf_stat.encrypt > 0);
+  CU_ASSERT(perf_stat.other > 0);
+#else  /* !PERFSTAT */
+  CU_ASSERT(0 == perf_stat.decrypt);
+  CU_ASSERT(0 == perf_stat.frame_decode);
+  CU_ASSERT(0 == perf_stat.ack);
+  CU_ASSERT(0 == perf_stat.loss_detection);
+  CU_ASSERT(0 == perf_stat.cc);
+  CU_ASSERT(0 == perf_stat.encrypt);
+  CU_ASSERT(0 == perf_stat.other);
+#endif /* !PERFSTAT */
+  CU_ASSERT(NGTCP2_PERF_PHASE_NONE == conn->perf.phase);
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_pmtud_loss(void) {
+void test_ngtcp2_conn_stall_stat(void) {
   ngtcp2_conn *conn;
-  uint8_t buf[2048];
+  uint8_t buf[1200];
   ngtcp2_ssize spktlen;
-  uint64_t t = 0;
-  ngtcp2_frame fr;
-  int64_t pkt_num = 0;
-  size_t pktlen;
-  int rv;
+  int64_t stream_id;
+  ngtcp2_strm *strm;
+  ngtcp2_stall_stat stall_stat;
+  uint64_t max_offset;
 
   setup_default_client(&conn);
 
-  ngtcp2_conn_start_pmtud(conn);
+  ngtcp2_conn_open_bidi_stream(conn, &stream_id, NULL);
+  strm = ngtcp2_conn_find_stream(conn, stream_id);
 
-  /* This sends PMTUD packet. */
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 100, 0);
 
-  CU_ASSERT(1406 == spktlen);
+  CU_ASSERT(spktlen > 0);
 
-  t += NGTCP2_SECONDS;
+  /* Nothing to send */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf),
+                                  10 * NGTCP2_MILLISECONDS);
 
-  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf), ++t);
+  CU_ASSERT(0 == spktlen);
+  CU_ASSERT(NGTCP2_STALL_CAUSE_APP == conn->stall.cause);
 
-  CU_ASSERT(spktlen > 0);
+  /* Connection-level flow control */
+  max_offset = conn->tx.max_offset;
+  conn->tx.max_offset = conn->tx.offset;
 
-  fr.type = NGTCP2_FRAME_ACK;
-  fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
-  fr.ack.ack_delay = 0;
-  fr.ack.first_ack_blklen = 0;
-  fr.ack.num_blks = 0;
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 100, 30 * NGTCP2_MILLISECONDS);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, pkt_num++,
-                                  &fr, conn->pktns.crypto.rx.ckm);
+  CU_ASSERT(0 == spktlen);
+  CU_ASSERT(NGTCP2_STALL_CAUSE_CONN_FLOW_CONTROL == conn->stall.cause);
 
-  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, ++t);
+  /* Stream-level flow control */
+  conn->tx.max_offset = max_offset;
+  max_offset = strm->tx.max_offset;
+  strm->tx.max_offset = strm->tx.offset;
 
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(1 == conn->pktns.rtb.num_lost_pkts);
-  CU_ASSERT(1 == conn->pktns.rtb.num_lost_pmtud_pkts);
-  CU_ASSERT(0 == conn->pktns.rtb.cc_bytes_in_flight);
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 100, 60 * NGTCP2_MILLISECONDS);
 
-  ngtcp2_conn_del(conn);
-}
+  CU_ASSERT(NGTCP2_ERR_STREAM_DATA_BLOCKED == spktlen);
+  CU_ASSERT(NGTCP2_STALL_CAUSE_STREAM_FLOW_CONTROL == conn->stall.cause);
 
-typedef struct failmalloc {
-  size_t nmalloc;
-  size_t fail_start;
-} failmalloc;
+  /* Congestion window */
+  strm->tx.max_offset = max_offset;
+  conn->cstat.bytes_in_flight += conn->cstat.cwnd;
 
-static void *failmalloc_malloc(size_t size, void *user_data) {
-  failmalloc *mc = user_data;
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 100, 100 * NGTCP2_MILLISECONDS);
 
-  if (mc->fail_start <= ++mc->nmalloc) {
-    return NULL;
-  }
+  CU_ASSERT(0 == spktlen);
+  CU_ASSERT(NGTCP2_STALL_CAUSE_CWND == conn->stall.cause);
 
-  return malloc(size);
-}
+  /* Pacing */
+  conn->cstat.bytes_in_flight -= conn->cstat.cwnd;
+  conn->tx.pacing.next_ts = 200 * NGTCP2_MILLISECONDS;
 
-static void failmalloc_free(void *ptr, void *user_data) {
-  (void)user_data;
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 100, 150 * NGTCP2_MILLISECONDS);
 
-  free(ptr);
-}
+  CU_ASSERT(0 == spktlen);
+  CU_ASSERT(NGTCP2_STALL_CAUSE_PACING == conn->stall.cause);
 
-static void *failmalloc_calloc(size_t nmemb, size_t size, void *user_data) {
-  failmalloc *mc = user_data;
+  conn->tx.pacing.next_ts = UINT64_MAX;
 
-  if (mc->fail_start <= ++mc->nmalloc) {
-    return NULL;
-  }
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, stream_id,
+                                     null_data, 100, 180 * NGTCP2_MILLISECONDS);
 
-  return calloc(nmemb, size);
-}
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(NGTCP2_STALL_CAUSE_NONE == conn->stall.cause);
 
-static void *failmalloc_realloc(void *ptr, size_t size, void *user_data) {
-  failmalloc *mc = user_data;
+  ngtcp2_conn_get_stall_stat(conn, &stall_stat);
 
-  if (mc->fail_start <= ++mc->nmalloc) {
-    return NULL;
-  }
+  CU_ASSERT(20 * NGTCP2_MILLISECONDS == stall_stat.app);
+  CU_ASSERT(30 * NGTCP2_MILLISECONDS == stall_stat.conn_flow_control);
+  CU_ASSERT(40 * NGTCP2_MILLISECONDS == stall_stat.stream_flow_control);
+  CU_ASSERT(50 * NGTCP2_MILLISECONDS == stall_stat.cwnd);
+  CU_ASSERT(30 * NGTCP2_MILLISECONDS == stall_stat.pacing);
 
-  return realloc(ptr, size);
+  ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_conn_new_failmalloc(void) {
+void test_ngtcp2_conn_latency_stat(void) {
   ngtcp2_conn *conn;
-  ngtcp2_callbacks cb;
   ngtcp2_settings settings;
-  ngtcp2_transport_params params;
-  failmalloc mc;
-  ngtcp2_mem mem = {
-      &mc,
-      failmalloc_malloc,
-      failmalloc_free,
-      failmalloc_calloc,
-      failmalloc_realloc,
-  };
-  ngtcp2_vec token = {
-      (uint8_t *)"token",
-      sizeof("token") - 1,
-  };
-  uint32_t preferred_versions[] = {
-      NGTCP2_PROTO_VER_V1,
-      NGTCP2_PROTO_VER_V2_DRAFT,
-  };
-  uint32_t other_versions[] = {
-      NGTCP2_PROTO_VER_V2_DRAFT,
-      NGTCP2_PROTO_VER_V1,
-      0x5a9aeaca,
-  };
-  ngtcp2_cid dcid, scid;
+  uint8_t buf[1200];
+  ngtcp2_frame fr;
+  size_t pktlen;
+  ngtcp2_ssize spktlen;
+  ngtcp2_latency_stat latency_stat;
+  uint64_t max_offset;
   int rv;
   size_t i;
-  size_t nmalloc;
-
-  dcid_init(&dcid);
-  scid_init(&scid);
-
-  ngtcp2_settings_default(&settings);
-  ngtcp2_transport_params_default(&params);
-
-  settings.qlog.write = qlog_write;
-  settings.token = token;
-  settings.preferred_versions = preferred_versions;
-  settings.preferred_versionslen = arraylen(preferred_versions);
-  settings.other_versions = other_versions;
-  settings.other_versionslen = arraylen(other_versions);
 
-  /* server */
-  server_default_callbacks(&cb);
+  /* The lower bound of each bucket falls into the bucket. */
+  for (i = 0; i < NGTCP2_LATENCY_HIST_NBUCKET; ++i) {
+    CU_ASSERT(i ==
+              ngtcp2_latency_hist_bucket(ngtcp2_latency_hist_bucket_lower(i)));
+  }
 
-  mc.nmalloc = 0;
-  mc.fail_start = SIZE_MAX;
+  CU_ASSERT(16 == ngtcp2_latency_hist_bucket(17));
+  CU_ASSERT(17 == ngtcp2_latency_hist_bucket(18));
+  CU_ASSERT(NGTCP2_LATENCY_HIST_NBUCKET - 1 ==
+            ngtcp2_latency_hist_bucket(UINT64_MAX));
 
-  rv = ngtcp2_conn_server_new(&conn, &dcid, &scid, &null_path.path,
-                              NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
-                              &mem, NULL);
+  /* Disabled */
+  setup_default_server(&conn);
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL == conn->latency);
 
-  ngtcp2_conn_del(conn);
+  ngtcp2_conn_get_latency_stat(conn, &latency_stat);
 
-  nmalloc = mc.nmalloc;
+  CU_ASSERT(0 == latency_stat.recv_to_app.count);
 
-  for (i = 0; i <= nmalloc; ++i) {
-    mc.nmalloc = 0;
-    mc.fail_start = i;
+  ngtcp2_conn_del(conn);
 
-    rv = ngtcp2_conn_server_new(&conn, &dcid, &scid, &null_path.path,
-                                NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
-                                &mem, NULL);
+  /* Enabled */
+  server_default_settings(&settings);
+  settings.latency_stat = 1;
 
-    CU_ASSERT(NGTCP2_ERR_NOMEM == rv);
-  }
+  setup_default_server_settings(&conn, &settings);
 
-  mc.nmalloc = 0;
-  mc.fail_start = nmalloc + 1;
+  /* Out of order data wait for the gap to be filled. */
+  fr.type = NGTCP2_FRAME_STREAM;
+  fr.stream.flags = 0;
+  fr.stream.stream_id = 0;
+  fr.stream.fin = 0;
+  fr.stream.offset = 100;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].len = 100;
+  fr.stream.data[0].base = null_data;
 
-  rv = ngtcp2_conn_server_new(&conn, &dcid, &scid, &null_path.path,
-                              NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
-                              &mem, NULL);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 1, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen,
+                            NGTCP2_MILLISECONDS);
 
   CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == conn->latency->recv_to_app.count);
 
-  ngtcp2_conn_del(conn);
+  fr.stream.offset = 0;
 
-  /* client */
-  client_default_callbacks(&cb);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 2, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen,
+                            5 * NGTCP2_MILLISECONDS);
 
-  mc.nmalloc = 0;
-  mc.fail_start = SIZE_MAX;
+  CU_ASSERT(0 == rv);
 
-  rv = ngtcp2_conn_client_new(&conn, &dcid, &scid, &null_path.path,
-                              NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
-                              &mem, NULL);
+  /* ACK is sent after the first ack-eliciting packet. */
+  spktlen = ngtcp2_conn_write_pkt(conn, NULL, NULL, buf, sizeof(buf),
+                                  7 * NGTCP2_MILLISECONDS);
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(spktlen > 0);
 
-  ngtcp2_conn_del(conn);
+  /* Stream data are blocked by connection-level flow control. */
+  max_offset = conn->tx.max_offset;
+  conn->tx.max_offset = conn->tx.offset;
 
-  nmalloc = mc.nmalloc;
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, 0,
+                                     null_data, 100, 10 * NGTCP2_MILLISECONDS);
 
-  for (i = 0; i <= nmalloc; ++i) {
-    mc.nmalloc = 0;
-    mc.fail_start = i;
+  CU_ASSERT(0 == spktlen);
 
-    rv = ngtcp2_conn_client_new(&conn, &dcid, &scid, &null_path.path,
-                                NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
-                                &mem, NULL);
+  conn->tx.max_offset = max_offset;
 
-    CU_ASSERT(NGTCP2_ERR_NOMEM == rv);
-  }
+  spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf), NULL,
+                                     NGTCP2_WRITE_STREAM_FLAG_NONE, 0,
+                                     null_data, 100, 15 * NGTCP2_MILLISECONDS);
 
-  mc.nmalloc = 0;
-  mc.fail_start = nmalloc + 1;
+  CU_ASSERT(spktlen > 0);
+  CU_ASSERT(UINT64_MAX == ngtcp2_conn_find_stream(conn, 0)->tx.offer_ts);
 
-  rv = ngtcp2_conn_client_new(&conn, &dcid, &scid, &null_path.path,
-                              NGTCP2_PROTO_VER_V1, &cb, &settings, &params,
-                              &mem, NULL);
+  ngtcp2_conn_get_latency_stat(conn, &latency_stat);
 
-  CU_ASSERT(0 == rv);
+  CU_ASSERT(2 == latency_stat.recv_to_app.count);
+  CU_ASSERT(4 * NGTCP2_MILLISECONDS == latency_stat.recv_to_app.sum);
+  CU_ASSERT(4 * NGTCP2_MILLISECONDS == latency_stat.recv_to_app.max);
+  CU_ASSERT(1 == latency_stat.recv_to_app.buckets[0]);
+  CU_ASSERT(1 == latency_stat.ack_delay.count);
+  CU_ASSERT(6 * NGTCP2_MILLISECONDS == latency_stat.ack_delay.max);
+  CU_ASSERT(1 == latency_stat.write_to_send.count);
+  CU_ASSERT(5 * NGTCP2_MILLISECONDS == latency_stat.write_to_send.max);
+  CU_ASSERT(4 * NGTCP2_MILLISECONDS ==
+            ngtcp2_latency_hist_percentile(&latency_stat.recv_to_app, 100));
+  CU_ASSERT(0 ==
+            ngtcp2_latency_hist_percentile(&latency_stat.recv_to_app, 50));
 
   ngtcp2_conn_del(conn);
 }
 
-void test_ngtcp2_accept(void) {
-  size_t pktlen;
-  uint8_t buf[2048];
-  ngtcp2_cid dcid, scid;
+void test_ngtcp2_conn_hol_stat(void) {
+  ngtcp2_conn *conn;
+  uint8_t buf[1200];
   ngtcp2_frame fr;
+  size_t pktlen;
+  ngtcp2_hol_stat hol_stat;
   int rv;
-  ngtcp2_pkt_hd hd;
-
-  dcid_init(&dcid);
-  scid_init(&scid);
-
-  /* Initial packet */
-  memset(&hd, 0, sizeof(hd));
-
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 1200;
-  fr.crypto.data[0].base = null_data;
-
-  pktlen = write_single_frame_initial_pkt(buf, sizeof(buf), &dcid, &scid, 0,
-                                          NGTCP2_PROTO_VER_V1, &fr, NULL, 0,
-                                          &null_ckm);
-
-  CU_ASSERT(pktlen >= 1200);
-
-  rv = ngtcp2_accept(&hd, buf, pktlen);
-
-  CU_ASSERT(0 == rv);
-  CU_ASSERT(ngtcp2_cid_eq(&dcid, &hd.dcid));
-  CU_ASSERT(ngtcp2_cid_eq(&scid, &hd.scid));
-  CU_ASSERT(0 == hd.token.len);
-  CU_ASSERT(hd.len > 0);
-  CU_ASSERT(NGTCP2_PROTO_VER_V1 == hd.version);
-  CU_ASSERT(NGTCP2_PKT_INITIAL == hd.type);
-  CU_ASSERT(hd.flags & NGTCP2_PKT_FLAG_LONG_FORM);
+  size_t i;
+  static const struct {
+    uint64_t offset;
+    ngtcp2_tstamp ts;
+  } offsets[] = {
+      {100, NGTCP2_MILLISECONDS},
+      {300, 2 * NGTCP2_MILLISECONDS},
+      {0, 5 * NGTCP2_MILLISECONDS},
+      {200, 9 * NGTCP2_MILLISECONDS},
+  };
 
-  /* 0RTT packet */
-  memset(&hd, 0, sizeof(hd));
+  setup_default_server(&conn);
 
   fr.type = NGTCP2_FRAME_STREAM;
   fr.stream.flags = 0;
   fr.stream.stream_id = 0;
   fr.stream.fin = 0;
-  fr.stream.offset = 0;
   fr.stream.datacnt = 1;
-  fr.stream.data[0].len = 1200;
+  fr.stream.data[0].len = 100;
   fr.stream.data[0].base = null_data;
 
-  pktlen = write_single_frame_0rtt_pkt(buf, sizeof(buf), &dcid, &scid, 1,
-                                       NGTCP2_PROTO_VER_V1, &fr, &null_ckm);
+  for (i = 0; i < arraylen(offsets); ++i) {
+    fr.stream.offset = offsets[i].offset;
 
-  CU_ASSERT(pktlen >= 1200);
+    pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid,
+                                    (int64_t)i, &fr,
+                                    conn->pktns.crypto.rx.ckm);
+    rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen,
+                              offsets[i].ts);
 
-  rv = ngtcp2_accept(&hd, buf, pktlen);
+    CU_ASSERT(0 == rv);
 
-  CU_ASSERT(NGTCP2_ERR_RETRY == rv);
-  CU_ASSERT(ngtcp2_cid_eq(&dcid, &hd.dcid));
-  CU_ASSERT(ngtcp2_cid_eq(&scid, &hd.scid));
-  CU_ASSERT(0 == hd.token.len);
-  CU_ASSERT(hd.len > 0);
-  CU_ASSERT(NGTCP2_PROTO_VER_V1 == hd.version);
-  CU_ASSERT(NGTCP2_PKT_0RTT == hd.type);
-  CU_ASSERT(hd.flags & NGTCP2_PKT_FLAG_LONG_FORM);
+    rv = ngtcp2_conn_get_stream_hol_stat(conn, 0, &hol_stat);
 
-  /* Unknown version */
-  memset(&hd, 0, sizeof(hd));
+    CU_ASSERT(0 == rv);
+    CU_ASSERT(1 == hol_stat.nblocked);
 
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 1200;
-  fr.crypto.data[0].base = null_data;
+    if (i < 3) {
+      CU_ASSERT(0 == hol_stat.blocked_duration);
+    }
+  }
 
-  pktlen =
-      write_single_frame_handshake_pkt(buf, sizeof(buf), NGTCP2_PKT_INITIAL,
-                                       &dcid, &scid, 0, 0x2, &fr, &null_ckm);
+  CU_ASSERT(UINT64_MAX == ngtcp2_conn_find_stream(conn, 0)->rx.hol_start);
 
-  CU_ASSERT(pktlen >= 1200);
+  /* Data in order do not count. */
+  fr.stream.stream_id = 4;
+  fr.stream.offset = 0;
 
-  rv = ngtcp2_accept(&hd, buf, pktlen);
+  pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, 4, &fr,
+                                  conn->pktns.crypto.rx.ckm);
+  rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen,
+                            10 * NGTCP2_MILLISECONDS);
 
-  /* Unknown version should be filtered out by earlier call of
-     ngtcp2_pkt_decode_version_cid, that is, only supported versioned
-     packet should be passed to ngtcp2_accept. */
-  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
+  CU_ASSERT(0 == rv);
 
-  /* Unknown version and the UDP payload size is less than
-     NGTCP2_MAX_UDP_PAYLOAD_SIZE. */
-  memset(&hd, 0, sizeof(hd));
+  rv = ngtcp2_conn_get_stream_hol_stat(conn, 4, &hol_stat);
 
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 1127;
-  fr.crypto.data[0].base = null_data;
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == hol_stat.nblocked);
+  CU_ASSERT(0 == hol_stat.blocked_bytes);
 
-  pktlen =
-      write_single_frame_handshake_pkt(buf, sizeof(buf), NGTCP2_PKT_INITIAL,
-                                       &dcid, &scid, 0, 0x2, &fr, &null_ckm);
+  ngtcp2_conn_get_stream_hol_stat(conn, 0, &hol_stat);
 
-  CU_ASSERT(1199 == pktlen);
+  CU_ASSERT(200 == hol_stat.blocked_bytes);
+  CU_ASSERT(8 * NGTCP2_MILLISECONDS == hol_stat.blocked_duration);
 
-  rv = ngtcp2_accept(&hd, buf, pktlen);
+  ngtcp2_conn_get_hol_stat(conn, &hol_stat);
 
-  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
+  CU_ASSERT(1 == hol_stat.nblocked);
+  CU_ASSERT(200 == hol_stat.blocked_bytes);
+  CU_ASSERT(8 * NGTCP2_MILLISECONDS == hol_stat.blocked_duration);
 
-  /* Short packet */
-  memset(&hd, 0, sizeof(hd));
+  rv = ngtcp2_conn_get_stream_hol_stat(conn, 8, &hol_stat);
 
-  fr.type = NGTCP2_FRAME_CRYPTO;
-  fr.crypto.offset = 0;
-  fr.crypto.datacnt = 1;
-  fr.crypto.data[0].len = 1200;
-  fr.crypto.data[0].base = null_data;
+  CU_ASSERT(NGTCP2_ERR_STREAM_NOT_FOUND == rv);
 
-  pktlen = write_single_frame_pkt(buf, sizeof(buf), &dcid, 0, &fr, &null_ckm);
+  ngtcp2_conn_del(conn);
+}
 
-  CU_ASSERT(pktlen >= 1200);
+void test_ngtcp2_conn_steady_state_alloc(void) {
+  ngtcp2_conn *conn;
+  ngtcp2_settings settings;
+  countmem cm;
+  uint8_t buf[1200];
+  ngtcp2_frame fr;
+  size_t pktlen;
+  ngtcp2_ssize spktlen;
+  ngtcp2_ssize datalen;
+  int64_t stream_id;
+  int64_t pkt_num = 0;
+  ngtcp2_tstamp t = 0;
+  size_t nwrite_alloc = 0, nread_alloc = 0;
+  size_t nalloc;
+  size_t i;
+  int rv;
 
-  rv = ngtcp2_accept(&hd, buf, pktlen);
+  countmem_init(&cm);
+  server_default_settings(&settings);
 
-  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
+  setup_default_server_mem(&conn, &settings, &cm.mem);
 
-  /* Unable to decode packet header */
-  memset(&hd, 0, sizeof(hd));
+  rv = ngtcp2_conn_open_uni_stream(conn, &stream_id, NULL);
 
-  memset(buf, 0, 4);
-  buf[0] = NGTCP2_HEADER_FORM_BIT;
+  CU_ASSERT(0 == rv);
 
-  rv = ngtcp2_accept(&hd, buf, 4);
+  fr.type = NGTCP2_FRAME_ACK;
+  fr.ack.ack_delay = 0;
+  fr.ack.first_ack_blklen = 0;
+  fr.ack.num_blks = 0;
 
-  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
-}
+  /* The first iterations warm up the object pools.  After that, the
+     bulk STREAM send and ACK receive loop must not allocate. */
+  for (i = 0; i < 64 + 256; ++i) {
+    if (i == 64) {
+      nwrite_alloc = nread_alloc = 0;
+    }
 
-void test_ngtcp2_select_version(void) {
-  CU_ASSERT(0 == ngtcp2_select_version(NULL, 0, NULL, 0));
+    t += NGTCP2_MILLISECONDS;
 
-  {
-    uint32_t preferred_versions[] = {NGTCP2_PROTO_VER_V1,
-                                     NGTCP2_PROTO_VER_V2_DRAFT};
-    uint32_t offered_versions[] = {0x00000004, 0x00000003,
-                                   NGTCP2_PROTO_VER_V2_DRAFT};
+    nalloc = cm.nalloc;
 
-    CU_ASSERT(
-        NGTCP2_PROTO_VER_V2_DRAFT ==
-        ngtcp2_select_version(preferred_versions, arraylen(preferred_versions),
-                              offered_versions, arraylen(offered_versions)));
-  }
+    spktlen = ngtcp2_conn_write_stream(conn, NULL, NULL, buf, sizeof(buf),
+                                       &datalen, NGTCP2_WRITE_STREAM_FLAG_NONE,
+                                       stream_id, null_data, 100, t);
 
-  {
-    uint32_t preferred_versions[] = {NGTCP2_PROTO_VER_V1,
-                                     NGTCP2_PROTO_VER_V2_DRAFT};
-    uint32_t offered_versions[] = {0x00000004, 0x00000003};
+    CU_ASSERT(spktlen > 0);
+    CU_ASSERT(100 == datalen);
 
-    CU_ASSERT(0 == ngtcp2_select_version(
-                       preferred_versions, arraylen(preferred_versions),
-                       offered_versions, arraylen(offered_versions)));
-  }
-}
+    nwrite_alloc += cm.nalloc - nalloc;
 
-void test_ngtcp2_pkt_write_connection_close(void) {
-  ngtcp2_ssize spktlen;
-  uint8_t buf[1200];
-  ngtcp2_cid dcid, scid;
-  ngtcp2_crypto_aead aead = {0, NGTCP2_INITIAL_AEAD_OVERHEAD};
-  ngtcp2_crypto_cipher hp_mask = {0};
-  ngtcp2_crypto_aead_ctx aead_ctx = {0};
-  ngtcp2_crypto_cipher_ctx hp_ctx = {0};
+    fr.ack.largest_ack = conn->pktns.tx.last_pkt_num;
 
-  dcid_init(&dcid);
-  scid_init(&scid);
+    pktlen = write_single_frame_pkt(buf, sizeof(buf), &conn->oscid, pkt_num++,
+                                    &fr, conn->pktns.crypto.rx.ckm);
 
-  spktlen = ngtcp2_pkt_write_connection_close(
-      buf, sizeof(buf), NGTCP2_PROTO_VER_V1, &dcid, &scid, NGTCP2_INVALID_TOKEN,
-      (const uint8_t *)"foo", 3, null_encrypt, &aead, &aead_ctx, null_iv,
-      null_hp_mask, &hp_mask, &hp_ctx);
+    t += NGTCP2_MILLISECONDS;
 
-  CU_ASSERT(spktlen > 0);
+    nalloc = cm.nalloc;
 
-  spktlen = ngtcp2_pkt_write_connection_close(
-      buf, 16, NGTCP2_PROTO_VER_V1, &dcid, &scid, NGTCP2_INVALID_TOKEN, NULL, 0,
-      null_encrypt, &aead, &aead_ctx, null_iv, null_hp_mask, &hp_mask, &hp_ctx);
+    rv = ngtcp2_conn_read_pkt(conn, &null_path.path, &null_pi, buf, pktlen, t);
 
-  CU_ASSERT(NGTCP2_ERR_NOBUF == spktlen);
+    CU_ASSERT(0 == rv);
+
+    nread_alloc += cm.nalloc - nalloc;
+  }
+
+  CU_ASSERT(0 == nwrite_alloc);
+  CU_ASSERT(0 == nread_alloc);
+
+  ngtcp2_conn_del(conn);
 }
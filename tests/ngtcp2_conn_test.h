@@ -37,6 +37,15 @@ void test_ngtcp2_conn_stream_rx_flow_control_error(void);
 void test_ngtcp2_conn_stream_tx_flow_control(void);
 void test_ngtcp2_conn_rx_flow_control(void);
 void test_ngtcp2_conn_rx_flow_control_error(void);
+void test_ngtcp2_conn_mem_budget(void);
+void test_ngtcp2_conn_hibernate(void);
+void test_ngtcp2_conn_shared_pool(void);
+void test_ngtcp2_conn_free_handshake_only_state(void);
+void test_ngtcp2_conn_snapshot(void);
+void test_ngtcp2_conn_snapshot_aead_limit(void);
+void test_ngtcp2_conn_published_conn_stat(void);
+void test_ngtcp2_conn_flow_window_autotuning(void);
+void test_ngtcp2_conn_coalesce_flow_control_update(void);
 void test_ngtcp2_conn_tx_flow_control(void);
 void test_ngtcp2_conn_shutdown_stream_write(void);
 void test_ngtcp2_conn_recv_reset_stream(void);
@@ -47,11 +56,15 @@ void test_ngtcp2_conn_recv_stateless_reset(void);
 void test_ngtcp2_conn_recv_retry(void);
 void test_ngtcp2_conn_recv_delayed_handshake_pkt(void);
 void test_ngtcp2_conn_recv_max_streams(void);
+void test_ngtcp2_conn_auto_max_streams(void);
 void test_ngtcp2_conn_handshake(void);
 void test_ngtcp2_conn_handshake_error(void);
+void test_ngtcp2_conn_retransmit_first(void);
 void test_ngtcp2_conn_retransmit_protected(void);
 void test_ngtcp2_conn_send_max_stream_data(void);
 void test_ngtcp2_conn_recv_stream_data(void);
+void test_ngtcp2_conn_read_pkts(void);
+void test_ngtcp2_conn_decrypt_in_place(void);
 void test_ngtcp2_conn_recv_ping(void);
 void test_ngtcp2_conn_recv_max_stream_data(void);
 void test_ngtcp2_conn_send_early_data(void);
@@ -60,16 +73,30 @@ void test_ngtcp2_conn_recv_compound_pkt(void);
 void test_ngtcp2_conn_pkt_payloadlen(void);
 void test_ngtcp2_conn_writev_stream(void);
 void test_ngtcp2_conn_writev_datagram(void);
+void test_ngtcp2_conn_protect_pkts(void);
+void test_ngtcp2_conn_protect_job(void);
+void test_ngtcp2_conn_prepare_rx_hp_masks(void);
+void test_ngtcp2_conn_enqueue_datagram(void);
 void test_ngtcp2_conn_recv_datagram(void);
+void test_ngtcp2_conn_recv_ack_frequency(void);
+void test_ngtcp2_conn_recv_ecn_ce(void);
+void test_ngtcp2_conn_spin_bit(void);
+void test_ngtcp2_conn_fec(void);
 void test_ngtcp2_conn_recv_new_connection_id(void);
 void test_ngtcp2_conn_recv_retire_connection_id(void);
+void test_ngtcp2_conn_get_new_connection_ids(void);
 void test_ngtcp2_conn_server_path_validation(void);
+void test_ngtcp2_conn_get_path_stat(void);
 void test_ngtcp2_conn_client_connection_migration(void);
 void test_ngtcp2_conn_recv_path_challenge(void);
 void test_ngtcp2_conn_key_update(void);
+void test_ngtcp2_conn_eager_key_update(void);
+void test_ngtcp2_conn_auto_key_update(void);
+void test_ngtcp2_conn_crypto_offload(void);
 void test_ngtcp2_conn_crypto_buffer_exceeded(void);
 void test_ngtcp2_conn_handshake_probe(void);
 void test_ngtcp2_conn_handshake_loss(void);
+void test_ngtcp2_conn_amplification_limit(void);
 void test_ngtcp2_conn_recv_client_initial_retry(void);
 void test_ngtcp2_conn_recv_client_initial_token(void);
 void test_ngtcp2_conn_get_active_dcid(void);
@@ -80,20 +107,43 @@ void test_ngtcp2_conn_write_connection_close(void);
 void test_ngtcp2_conn_write_application_close(void);
 void test_ngtcp2_conn_rtb_reclaim_on_pto(void);
 void test_ngtcp2_conn_rtb_reclaim_on_pto_datagram(void);
+void test_ngtcp2_conn_pto_probe_policy(void);
 void test_ngtcp2_conn_validate_ecn(void);
 void test_ngtcp2_conn_path_validation(void);
 void test_ngtcp2_conn_early_data_sync_stream_data_limit(void);
 void test_ngtcp2_conn_early_data_rejected(void);
 void test_ngtcp2_conn_keep_alive(void);
+void test_ngtcp2_conn_keep_alive_external(void);
 void test_ngtcp2_conn_retire_stale_bound_dcid(void);
 void test_ngtcp2_conn_get_scid(void);
 void test_ngtcp2_conn_stream_close(void);
+void test_ngtcp2_conn_acked_stream_data_offset(void);
+void test_ngtcp2_conn_release_stream_buf(void);
+void test_ngtcp2_conn_relay(void);
+void test_ngtcp2_conn_stream_sendbuf(void);
+void test_ngtcp2_conn_stream_sched(void);
+void test_ngtcp2_conn_writev_streams(void);
+void test_ngtcp2_conn_write_burst(void);
+void test_ngtcp2_conn_pkt_tx_time(void);
+void test_ngtcp2_conn_get_expiry(void);
+void test_ngtcp2_conn_perf_stat(void);
+void test_ngtcp2_conn_stall_stat(void);
+void test_ngtcp2_conn_latency_stat(void);
+void test_ngtcp2_conn_hol_stat(void);
+void test_ngtcp2_conn_steady_state_alloc(void);
+void test_ngtcp2_conn_ack_frame_cache(void);
 void test_ngtcp2_conn_buffer_pkt(void);
 void test_ngtcp2_conn_handshake_timeout(void);
 void test_ngtcp2_conn_get_connection_close_error(void);
 void test_ngtcp2_conn_version_negotiation(void);
 void test_ngtcp2_conn_server_negotiate_version(void);
 void test_ngtcp2_conn_pmtud_loss(void);
+void test_ngtcp2_conn_pmtud_probe_data(void);
+void test_ngtcp2_conn_pmtud_black_hole(void);
+void test_ngtcp2_conn_user_cc(void);
+void test_ngtcp2_conn_cc_resume(void);
+void test_ngtcp2_encode_cc_resume_params(void);
+void test_ngtcp2_conn_spurious_loss(void);
 void test_ngtcp2_conn_new_failmalloc(void);
 void test_ngtcp2_accept(void);
 void test_ngtcp2_select_version(void);
@@ -24,6 +24,8 @@
  */
 #include "ngtcp2_conv_test.h"
 
+#include <string.h>
+
 #include <CUnit/CUnit.h>
 
 #include "ngtcp2_conv.h"
@@ -124,6 +126,60 @@ void test_ngtcp2_get_varint(void) {
   CU_ASSERT(4611686018427387903ULL == n);
 }
 
+void test_ngtcp2_get_varints(void) {
+  static const uint64_t nums[] = {
+      0,
+      63,
+      64,
+      16383,
+      16384,
+      1073741823,
+      1073741824,
+      4611686018427387903ULL,
+      37,
+      15293,
+      494878333,
+      151288809941952652ULL,
+  };
+  uint8_t buf[256];
+  uint8_t *p = buf;
+  uint64_t dest[arraylen(nums)];
+  ngtcp2_ssize nread;
+  size_t i, len;
+
+  for (i = 0; i < arraylen(nums); ++i) {
+    p = ngtcp2_put_varint(p, nums[i]);
+  }
+
+  len = (size_t)(p - buf);
+
+  /* The last integers are decoded byte by byte. */
+  memset(dest, 0, sizeof(dest));
+  nread = ngtcp2_get_varints(dest, arraylen(nums), buf, len);
+
+  CU_ASSERT((ngtcp2_ssize)len == nread);
+
+  for (i = 0; i < arraylen(nums); ++i) {
+    CU_ASSERT(nums[i] == dest[i]);
+  }
+
+  /* The trailing bytes are left unread. */
+  memset(buf + len, 0xff, 8);
+  nread = ngtcp2_get_varints(dest, 3, buf, len + 8);
+
+  CU_ASSERT(1 + 1 + 2 == nread);
+  CU_ASSERT(64 == dest[2]);
+
+  /* Truncated */
+  nread = ngtcp2_get_varints(dest, arraylen(nums), buf, len - 1);
+
+  CU_ASSERT(-1 == nread);
+
+  nread = ngtcp2_get_varints(dest, 1, buf, 0);
+
+  CU_ASSERT(-1 == nread);
+}
+
 void test_ngtcp2_get_varint_len(void) {
   uint8_t c;
 
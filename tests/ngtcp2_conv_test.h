@@ -30,6 +30,7 @@
 #endif /* HAVE_CONFIG_H */
 
 void test_ngtcp2_get_varint(void);
+void test_ngtcp2_get_varints(void);
 void test_ngtcp2_get_varint_len(void);
 void test_ngtcp2_put_varint_len(void);
 void test_ngtcp2_nth_server_bidi_id(void);
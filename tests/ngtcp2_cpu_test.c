@@ -0,0 +1,70 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_cpu_test.h"
+
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+
+#include "ngtcp2_cpu.h"
+#include "ngtcp2_test_helper.h"
+
+void test_ngtcp2_cpu_memxor(void) {
+  /* Test the generic kernel and the one selected for the running
+     CPU. */
+  uint32_t features[] = {0, ngtcp2_cpu_get_features()};
+  const ngtcp2_cpu_dispatch *dispatch;
+  uint8_t src[1500 + 3], dest[1500 + 3], expected[1500 + 3];
+  size_t i, j, k, n;
+
+  for (i = 0; i < sizeof(src); ++i) {
+    src[i] = (uint8_t)(i * 7 + 1);
+  }
+
+  for (i = 0; i < arraylen(features); ++i) {
+    dispatch = ngtcp2_cpu_select_dispatch(features[i]);
+
+    for (n = 0; n <= 1500; n = n < 80 ? n + 1 : n + 355) {
+      /* Exercise the unaligned head and tail. */
+      for (j = 0; j < 3; ++j) {
+        for (k = 0; k < sizeof(dest); ++k) {
+          dest[k] = expected[k] = (uint8_t)(k * 13);
+        }
+
+        for (k = 0; k < n; ++k) {
+          expected[j + k] ^= src[3 - j + k];
+        }
+
+        dispatch->memxor(dest + j, src + 3 - j, n);
+
+        CU_ASSERT(0 == memcmp(expected, dest, sizeof(dest)));
+      }
+    }
+  }
+
+  CU_ASSERT(ngtcp2_cpu_get_dispatch() ==
+            ngtcp2_cpu_select_dispatch(ngtcp2_cpu_get_features()));
+  CU_ASSERT(ngtcp2_cpu_get_dispatch() == ngtcp2_cpu_get_dispatch());
+}
@@ -171,6 +171,8 @@ void test_ngtcp2_encode_transport_params(void) {
   params.version_info.other_versions = other_versions;
   params.version_info.other_versionslen = sizeof(other_versions);
   params.version_info_present = 1;
+  params.min_ack_delay = 3 * NGTCP2_MILLISECONDS;
+  params.fec_window = 65536;
 
   len =
       varint_paramlen(NGTCP2_TRANSPORT_PARAM_INITIAL_MAX_STREAM_DATA_BIDI_LOCAL,
@@ -206,6 +208,10 @@ void test_ngtcp2_encode_transport_params(void) {
                       params.max_datagram_frame_size) +
       (ngtcp2_put_varint_len(NGTCP2_TRANSPORT_PARAM_GREASE_QUIC_BIT) +
        ngtcp2_put_varint_len(0)) +
+      varint_paramlen(NGTCP2_TRANSPORT_PARAM_MIN_ACK_DELAY_DRAFT,
+                      params.min_ack_delay / NGTCP2_MICROSECONDS) +
+      varint_paramlen(NGTCP2_TRANSPORT_PARAM_FEC_WINDOW_EXPERIMENTAL,
+                      params.fec_window) +
       (ngtcp2_put_varint_len(NGTCP2_TRANSPORT_PARAM_VERSION_INFORMATION_DRAFT) +
        ngtcp2_put_varint_len(sizeof(params.version_info.chosen_version) +
                              params.version_info.other_versionslen) +
@@ -251,6 +257,8 @@ void test_ngtcp2_encode_transport_params(void) {
             nparams.active_connection_id_limit);
   CU_ASSERT(params.max_datagram_frame_size == nparams.max_datagram_frame_size);
   CU_ASSERT(params.grease_quic_bit == nparams.grease_quic_bit);
+  CU_ASSERT(params.min_ack_delay == nparams.min_ack_delay);
+  CU_ASSERT(params.fec_window == nparams.fec_window);
   CU_ASSERT(params.version_info_present == nparams.version_info_present);
   CU_ASSERT(params.version_info.chosen_version ==
             nparams.version_info.chosen_version);
@@ -672,3 +680,134 @@ void test_ngtcp2_decode_transport_params_new(void) {
 
   ngtcp2_transport_params_del(nparams, NULL);
 }
+
+void test_ngtcp2_encode_transport_params_template(void) {
+  ngtcp2_transport_params params;
+  ngtcp2_transport_params_template tmpl;
+  uint8_t buf[512], tmplbuf[512];
+  ngtcp2_ssize nwrite, tmplnwrite;
+  ngtcp2_cid rcid, scid, dcid;
+  uint32_t other_versions[] = {NGTCP2_PROTO_VER_V1};
+
+  rcid_init(&rcid);
+  scid_init(&scid);
+  dcid_init(&dcid);
+
+  ngtcp2_transport_params_default(&params);
+  params.initial_max_stream_data_bidi_local = 1000000007;
+  params.initial_max_stream_data_bidi_remote = 961748941;
+  params.initial_max_stream_data_uni = 982451653;
+  params.initial_max_data = 1000000009;
+  params.initial_max_streams_bidi = 100;
+  params.initial_max_streams_uni = 3;
+  params.max_idle_timeout = 30 * NGTCP2_SECONDS;
+  params.max_udp_payload_size = 1200;
+  params.active_connection_id_limit = 7;
+  params.grease_quic_bit = 1;
+
+  ngtcp2_transport_params_template_init(&tmpl, &params);
+
+  CU_ASSERT(tmpl.datalen > 0);
+
+  /* Per-connection fields are encoded from params. */
+  params.original_dcid = dcid;
+  params.initial_scid = scid;
+  params.retry_scid = rcid;
+  params.retry_scid_present = 1;
+  params.stateless_reset_token_present = 1;
+  memset(params.stateless_reset_token, 0xf1,
+         sizeof(params.stateless_reset_token));
+  params.version_info_present = 1;
+  params.version_info.chosen_version = NGTCP2_PROTO_VER_V1;
+  params.version_info.other_versions = (uint8_t *)other_versions;
+  params.version_info.other_versionslen = sizeof(other_versions);
+
+  nwrite = ngtcp2_encode_transport_params(
+      buf, sizeof(buf), NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS,
+      &params);
+  tmplnwrite = ngtcp2_encode_transport_params_template(
+      tmplbuf, sizeof(tmplbuf),
+      NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS, &params, &tmpl);
+
+  CU_ASSERT(nwrite > 0);
+  CU_ASSERT(nwrite == tmplnwrite);
+  CU_ASSERT(0 == memcmp(buf, tmplbuf, (size_t)nwrite));
+
+  /* The template is ignored if the parameters do not match. */
+  params.initial_max_data = 1;
+  memset(tmpl.data, 0, tmpl.datalen);
+
+  nwrite = ngtcp2_encode_transport_params(
+      buf, sizeof(buf), NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS,
+      &params);
+  tmplnwrite = ngtcp2_encode_transport_params_template(
+      tmplbuf, sizeof(tmplbuf),
+      NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS, &params, &tmpl);
+
+  CU_ASSERT(nwrite == tmplnwrite);
+  CU_ASSERT(0 == memcmp(buf, tmplbuf, (size_t)nwrite));
+
+  /* Buffer too small */
+  tmplnwrite = ngtcp2_encode_transport_params_template(
+      tmplbuf, (size_t)nwrite - 1,
+      NGTCP2_TRANSPORT_PARAMS_TYPE_ENCRYPTED_EXTENSIONS, &params, &tmpl);
+
+  CU_ASSERT(NGTCP2_ERR_NOBUF == tmplnwrite);
+}
+
+void test_ngtcp2_transport_params_storage_copy(void) {
+  ngtcp2_transport_params params;
+  ngtcp2_transport_params_storage st;
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  uint8_t other_versions[NGTCP2_TRANSPORT_PARAMS_STORAGE_OTHER_VERSIONSLEN + 4];
+  int rv;
+
+  memset(other_versions, 0xf1, sizeof(other_versions));
+  memset(&params, 0, sizeof(params));
+  memset(&st, 0, sizeof(st));
+
+  params.initial_max_data = 1000000007;
+  params.version_info_present = 1;
+  params.version_info.chosen_version = NGTCP2_PROTO_VER_V1;
+  params.version_info.other_versions = other_versions;
+  params.version_info.other_versionslen = 8;
+
+  /* other_versions is held in place. */
+  rv = ngtcp2_transport_params_storage_copy(&st, &params, mem);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(params.initial_max_data == st.params.initial_max_data);
+  CU_ASSERT(st.other_versions == st.params.version_info.other_versions);
+  CU_ASSERT(8 == st.params.version_info.other_versionslen);
+  CU_ASSERT(0 == memcmp(other_versions, st.params.version_info.other_versions,
+                        8));
+
+  ngtcp2_transport_params_storage_free(&st, mem);
+
+  CU_ASSERT(NULL == st.params.version_info.other_versions);
+
+  /* other_versions which does not fit in is allocated. */
+  params.version_info.other_versionslen = sizeof(other_versions);
+
+  rv = ngtcp2_transport_params_storage_copy(&st, &params, mem);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(st.other_versions != st.params.version_info.other_versions);
+  CU_ASSERT(other_versions != st.params.version_info.other_versions);
+  CU_ASSERT(0 == memcmp(other_versions, st.params.version_info.other_versions,
+                        sizeof(other_versions)));
+
+  ngtcp2_transport_params_storage_free(&st, mem);
+
+  CU_ASSERT(NULL == st.params.version_info.other_versions);
+
+  /* version_info is absent. */
+  params.version_info_present = 0;
+
+  rv = ngtcp2_transport_params_storage_copy(&st, &params, mem);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NULL == st.params.version_info.other_versions);
+
+  ngtcp2_transport_params_storage_free(&st, mem);
+}
@@ -31,5 +31,7 @@
 
 void test_ngtcp2_encode_transport_params(void);
 void test_ngtcp2_decode_transport_params_new(void);
+void test_ngtcp2_encode_transport_params_template(void);
+void test_ngtcp2_transport_params_storage_copy(void);
 
 #endif /* NGTCP2_CRYPTO_TEST_H */
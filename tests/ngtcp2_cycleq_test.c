@@ -0,0 +1,166 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_cycleq_test.h"
+
+#include <CUnit/CUnit.h>
+
+#include "ngtcp2_cycleq.h"
+#include "ngtcp2_macro.h"
+#include "ngtcp2_test_helper.h"
+
+typedef struct cq_item {
+  ngtcp2_pq_entry pe;
+  uint64_t cycle;
+  int64_t id;
+} cq_item;
+
+static uint64_t cq_item_cycle(const ngtcp2_pq_entry *ent) {
+  return ngtcp2_struct_of(ent, cq_item, pe)->cycle;
+}
+
+static int cq_item_less(const ngtcp2_pq_entry *lhs,
+                        const ngtcp2_pq_entry *rhs) {
+  return ngtcp2_struct_of(lhs, cq_item, pe)->id <
+         ngtcp2_struct_of(rhs, cq_item, pe)->id;
+}
+
+static cq_item *cq_top(ngtcp2_cycleq *cq) {
+  return ngtcp2_struct_of(ngtcp2_cycleq_top(cq), cq_item, pe);
+}
+
+void test_ngtcp2_cycleq_round_robin(void) {
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  const int64_t ids[] = {8, 0, 12, 4};
+  cq_item items[5];
+  ngtcp2_cycleq cq;
+  cq_item *item;
+  size_t i;
+  int rv;
+
+  ngtcp2_cycleq_init(&cq, cq_item_cycle, cq_item_less, mem);
+
+  for (i = 0; i < arraylen(ids); ++i) {
+    items[i].cycle = 7;
+    items[i].id = ids[i];
+
+    rv = ngtcp2_cycleq_push(&cq, &items[i].pe);
+
+    CU_ASSERT(0 == rv);
+  }
+
+  CU_ASSERT(4 == ngtcp2_cycleq_size(&cq));
+
+  /* Serve each item, and push it back with the next cycle. */
+  for (i = 0; i < 8; ++i) {
+    item = cq_top(&cq);
+
+    CU_ASSERT((int64_t)(i % 4 * 4) == item->id);
+    CU_ASSERT(7 + i / 4 == item->cycle);
+
+    ngtcp2_cycleq_pop(&cq);
+    ++item->cycle;
+
+    rv = ngtcp2_cycleq_push(&cq, &item->pe);
+
+    CU_ASSERT(0 == rv);
+
+    if (i == 1) {
+      /* A new item takes the cycle of the top. */
+      items[4].cycle = cq_top(&cq)->cycle;
+      items[4].id = 2;
+
+      rv = ngtcp2_cycleq_push(&cq, &items[4].pe);
+
+      CU_ASSERT(0 == rv);
+
+      item = cq_top(&cq);
+
+      CU_ASSERT(2 == item->id);
+
+      ngtcp2_cycleq_pop(&cq);
+    }
+  }
+
+  CU_ASSERT(4 == ngtcp2_cycleq_size(&cq));
+  CU_ASSERT(9 == cq_top(&cq)->cycle);
+
+  for (i = 0; i < 4; ++i) {
+    ngtcp2_cycleq_pop(&cq);
+  }
+
+  CU_ASSERT(ngtcp2_cycleq_empty(&cq));
+
+  ngtcp2_cycleq_free(&cq);
+}
+
+void test_ngtcp2_cycleq_remove(void) {
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  cq_item items[64];
+  ngtcp2_cycleq cq;
+  cq_item *item;
+  size_t i;
+  uint64_t last_cycle;
+  int64_t last;
+  int rv;
+
+  ngtcp2_cycleq_init(&cq, cq_item_cycle, cq_item_less, mem);
+
+  /* Push out of order to exercise the insertion in the middle. */
+  for (i = 0; i < arraylen(items); ++i) {
+    items[i].cycle = 100 + (i % 2);
+    items[i].id = (int64_t)((i * 37) % arraylen(items));
+
+    rv = ngtcp2_cycleq_push(&cq, &items[i].pe);
+
+    CU_ASSERT(0 == rv);
+  }
+
+  for (i = 0; i < arraylen(items); i += 3) {
+    ngtcp2_cycleq_remove(&cq, &items[i].pe);
+  }
+
+  /* Removing an item and pushing it back does not allocate. */
+  ngtcp2_cycleq_remove(&cq, &items[1].pe);
+
+  rv = ngtcp2_cycleq_push(&cq, &items[1].pe);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(42 == ngtcp2_cycleq_size(&cq));
+
+  for (last_cycle = 0, last = -1; !ngtcp2_cycleq_empty(&cq);) {
+    item = cq_top(&cq);
+
+    CU_ASSERT(last_cycle < item->cycle ||
+              (last_cycle == item->cycle && last < item->id));
+
+    last_cycle = item->cycle;
+    last = item->id;
+    ngtcp2_cycleq_pop(&cq);
+  }
+
+  CU_ASSERT(101 == last_cycle);
+
+  ngtcp2_cycleq_free(&cq);
+}
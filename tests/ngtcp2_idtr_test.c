@@ -45,6 +45,10 @@ void test_ngtcp2_idtr_open(void) {
 
   CU_ASSERT(0 == rv);
 
+  rv = ngtcp2_idtr_sync_gap(&idtr);
+
+  CU_ASSERT(0 == rv);
+
   it = ngtcp2_ksl_begin(&idtr.gap.gap);
   key = *(ngtcp2_range *)ngtcp2_ksl_it_key(&it);
 
@@ -55,6 +59,10 @@ void test_ngtcp2_idtr_open(void) {
 
   CU_ASSERT(0 == rv);
 
+  rv = ngtcp2_idtr_sync_gap(&idtr);
+
+  CU_ASSERT(0 == rv);
+
   it = ngtcp2_ksl_begin(&idtr.gap.gap);
   key = *(ngtcp2_range *)ngtcp2_ksl_it_key(&it);
 
@@ -77,3 +85,103 @@ void test_ngtcp2_idtr_open(void) {
 
   ngtcp2_idtr_free(&idtr);
 }
+
+void test_ngtcp2_idtr_window(void) {
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  ngtcp2_idtr idtr;
+  int rv;
+  uint64_t i;
+
+  /* Opening in order slides the window without allocation. */
+  ngtcp2_idtr_init(&idtr, 0, mem);
+
+  for (i = 0; i < 1000; ++i) {
+    rv = ngtcp2_idtr_open(&idtr, stream_id_from_id(i));
+
+    CU_ASSERT(0 == rv);
+  }
+
+  CU_ASSERT(1000 == idtr.base);
+  CU_ASSERT(1000 == ngtcp2_idtr_first_gap(&idtr));
+  CU_ASSERT(0 == ngtcp2_ksl_len(&idtr.gap.gap));
+  CU_ASSERT(ngtcp2_idtr_is_open(&idtr, stream_id_from_id(999)));
+  CU_ASSERT(!ngtcp2_idtr_is_open(&idtr, stream_id_from_id(1000)));
+
+  rv = ngtcp2_idtr_open(&idtr, stream_id_from_id(999));
+
+  CU_ASSERT(NGTCP2_ERR_STREAM_IN_USE == rv);
+
+  ngtcp2_idtr_free(&idtr);
+
+  /* Out of order IDs within the window */
+  ngtcp2_idtr_init(&idtr, 1, mem);
+
+  rv = ngtcp2_idtr_open(&idtr, stream_id_from_id(2) + 1);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == idtr.base);
+
+  rv = ngtcp2_idtr_open(&idtr, stream_id_from_id(1) + 1);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == idtr.base);
+
+  rv = ngtcp2_idtr_open(&idtr, stream_id_from_id(0) + 1);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(3 == idtr.base);
+  CU_ASSERT(0 == ngtcp2_ksl_len(&idtr.gap.gap));
+
+  ngtcp2_idtr_free(&idtr);
+
+  /* IDs beyond the window fall back to gap, and are brought into
+     the window when it slides. */
+  ngtcp2_idtr_init(&idtr, 0, mem);
+
+  rv = ngtcp2_idtr_open(&idtr, stream_id_from_id(NGTCP2_IDTR_WINDOW_BITS));
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 != ngtcp2_ksl_len(&idtr.gap.gap));
+
+  rv = ngtcp2_idtr_open(&idtr,
+                        stream_id_from_id(NGTCP2_IDTR_WINDOW_BITS + 100));
+
+  CU_ASSERT(0 == rv);
+
+  for (i = 0; i < NGTCP2_IDTR_WINDOW_BITS; ++i) {
+    rv = ngtcp2_idtr_open(&idtr, stream_id_from_id(i));
+
+    CU_ASSERT(0 == rv);
+  }
+
+  CU_ASSERT(NGTCP2_IDTR_WINDOW_BITS + 1 == idtr.base);
+  CU_ASSERT(ngtcp2_idtr_is_open(
+      &idtr, stream_id_from_id(NGTCP2_IDTR_WINDOW_BITS + 100)));
+
+  rv = ngtcp2_idtr_open(&idtr,
+                        stream_id_from_id(NGTCP2_IDTR_WINDOW_BITS + 100));
+
+  CU_ASSERT(NGTCP2_ERR_STREAM_IN_USE == rv);
+
+  ngtcp2_idtr_free(&idtr);
+
+  /* IDs which are only in gap, e.g., restored from a snapshot */
+  ngtcp2_idtr_init(&idtr, 0, mem);
+
+  rv = ngtcp2_gaptr_push(&idtr.gap, 0, 1000);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(ngtcp2_idtr_is_open(&idtr, stream_id_from_id(999)));
+
+  rv = ngtcp2_idtr_open(&idtr, stream_id_from_id(500));
+
+  CU_ASSERT(NGTCP2_ERR_STREAM_IN_USE == rv);
+
+  rv = ngtcp2_idtr_open(&idtr, stream_id_from_id(1000));
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1001 == idtr.base);
+  CU_ASSERT(1001 == ngtcp2_idtr_first_gap(&idtr));
+
+  ngtcp2_idtr_free(&idtr);
+}
@@ -30,5 +30,6 @@
 #endif /* HAVE_CONFIG_H */
 
 void test_ngtcp2_idtr_open(void);
+void test_ngtcp2_idtr_window(void);
 
 #endif /* NGTCP2_IDTR_TEST_H */
@@ -500,3 +500,83 @@ void test_ngtcp2_ksl_remove_hint(void) {
     ngtcp2_ksl_free(&ksl);
   }
 }
+
+void test_ngtcp2_ksl_int64(void) {
+  static int64_t keys[2000];
+  ngtcp2_ksl ksl, ksl_greater;
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  ngtcp2_ksl_it it;
+  size_t i;
+  int64_t k;
+
+  for (i = 0; i < arraylen(keys); ++i) {
+    keys[i] = (int64_t)i * 2;
+  }
+
+  shuffle(keys, arraylen(keys));
+
+  ngtcp2_ksl_init(&ksl, ngtcp2_ksl_int64_less, sizeof(int64_t), mem);
+  ngtcp2_ksl_init(&ksl_greater, ngtcp2_ksl_int64_greater, sizeof(int64_t),
+                  mem);
+
+  for (i = 0; i < arraylen(keys); ++i) {
+    CU_ASSERT(0 == ngtcp2_ksl_insert(&ksl, NULL, &keys[i], NULL));
+    CU_ASSERT(0 == ngtcp2_ksl_insert(&ksl_greater, NULL, &keys[i], NULL));
+  }
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT ==
+            ngtcp2_ksl_insert(&ksl, NULL, &keys[0], NULL));
+
+  for (k = -1; k <= (int64_t)arraylen(keys) * 2; ++k) {
+    it = ngtcp2_ksl_lower_bound(&ksl, &k);
+
+    if (k >= (int64_t)arraylen(keys) * 2 - 1) {
+      CU_ASSERT(ngtcp2_ksl_it_end(&it));
+    } else {
+      CU_ASSERT(!ngtcp2_ksl_it_end(&it));
+      CU_ASSERT(((k + 1) & ~1) == *(int64_t *)ngtcp2_ksl_it_key(&it));
+    }
+
+    it = ngtcp2_ksl_lower_bound(&ksl_greater, &k);
+
+    if (k < 0) {
+      CU_ASSERT(ngtcp2_ksl_it_end(&it));
+    } else if (k >= (int64_t)arraylen(keys) * 2) {
+      CU_ASSERT((int64_t)arraylen(keys) * 2 - 2 ==
+                *(int64_t *)ngtcp2_ksl_it_key(&it));
+    } else {
+      CU_ASSERT(!ngtcp2_ksl_it_end(&it));
+      CU_ASSERT((k & ~1) == *(int64_t *)ngtcp2_ksl_it_key(&it));
+    }
+  }
+
+  for (i = 0; i < arraylen(keys); i += 2) {
+    CU_ASSERT(0 == ngtcp2_ksl_remove(&ksl, NULL, &keys[i]));
+    CU_ASSERT(0 == ngtcp2_ksl_remove(&ksl_greater, NULL, &keys[i]));
+  }
+
+  CU_ASSERT(arraylen(keys) / 2 == ngtcp2_ksl_len(&ksl));
+  CU_ASSERT(arraylen(keys) / 2 == ngtcp2_ksl_len(&ksl_greater));
+
+  for (i = 1; i < arraylen(keys); i += 2) {
+    it = ngtcp2_ksl_lower_bound(&ksl, &keys[i]);
+
+    CU_ASSERT(!ngtcp2_ksl_it_end(&it));
+    CU_ASSERT(keys[i] == *(int64_t *)ngtcp2_ksl_it_key(&it));
+
+    it = ngtcp2_ksl_lower_bound(&ksl_greater, &keys[i]);
+
+    CU_ASSERT(!ngtcp2_ksl_it_end(&it));
+    CU_ASSERT(keys[i] == *(int64_t *)ngtcp2_ksl_it_key(&it));
+  }
+
+  k = -1;
+  for (it = ngtcp2_ksl_begin(&ksl); !ngtcp2_ksl_it_end(&it);
+       ngtcp2_ksl_it_next(&it)) {
+    CU_ASSERT(k < *(int64_t *)ngtcp2_ksl_it_key(&it));
+    k = *(int64_t *)ngtcp2_ksl_it_key(&it);
+  }
+
+  ngtcp2_ksl_free(&ksl_greater);
+  ngtcp2_ksl_free(&ksl);
+}
@@ -35,5 +35,6 @@ void test_ngtcp2_ksl_range(void);
 void test_ngtcp2_ksl_update_key_range(void);
 void test_ngtcp2_ksl_dup(void);
 void test_ngtcp2_ksl_remove_hint(void);
+void test_ngtcp2_ksl_int64(void);
 
 #endif /* NGTCP2_KSL_TEST_H */
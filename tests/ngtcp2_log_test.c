@@ -0,0 +1,144 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_log_test.h"
+
+#include <stdio.h>
+#include <assert.h>
+
+#include <CUnit/CUnit.h>
+
+#include "ngtcp2_log.h"
+#include "ngtcp2_test_helper.h"
+
+typedef struct {
+  char data[8192];
+  size_t datalen;
+  size_t nrecord;
+} log_sink;
+
+static void log_sink_printf(void *user_data, const char *fmt, ...) {
+  log_sink *sink = user_data;
+  va_list ap;
+  int n;
+
+  va_start(ap, fmt);
+  n = vsnprintf(sink->data + sink->datalen, sizeof(sink->data) - sink->datalen,
+                fmt, ap);
+  va_end(ap);
+
+  assert(n >= 0);
+  assert((size_t)n + 1 < sizeof(sink->data) - sink->datalen);
+
+  sink->datalen += (size_t)n;
+  sink->data[sink->datalen++] = '\n';
+  sink->data[sink->datalen] = '\0';
+}
+
+static void log_sink_record(void *user_data, const ngtcp2_log_record *rec) {
+  log_sink *sink = user_data;
+
+  ++sink->nrecord;
+
+  /* Drop PADDING to make sure that nothing is rendered unless it is
+     asked. */
+  if (rec->type == NGTCP2_LOG_RECORD_TYPE_FRAME &&
+      rec->frame_type == NGTCP2_FRAME_PADDING) {
+    return;
+  }
+
+  ngtcp2_log_record_print(rec, log_sink_printf, sink);
+}
+
+static void log_events(ngtcp2_log *log, int padding) {
+  ngtcp2_pkt_hd hd;
+  ngtcp2_cid dcid, scid;
+  ngtcp2_frame fr;
+  ngtcp2_transport_params params;
+  uint32_t sv[] = {NGTCP2_PROTO_VER_V1, NGTCP2_PROTO_VER_V2_DRAFT};
+
+  dcid_init(&dcid);
+  scid_init(&scid);
+
+  log->last_ts = 17 * NGTCP2_MILLISECONDS;
+
+  ngtcp2_pkt_hd_init(&hd, NGTCP2_PKT_FLAG_LONG_FORM, NGTCP2_PKT_INITIAL, &dcid,
+                     &scid, 1000000007, 4, NGTCP2_PROTO_VER_V1, 1200);
+
+  ngtcp2_log_rx_pkt_hd(log, &hd);
+
+  fr.ack.type = NGTCP2_FRAME_ACK;
+  fr.ack.largest_ack = 100;
+  fr.ack.ack_delay = 25;
+  fr.ack.ack_delay_unscaled = 25 * NGTCP2_MILLISECONDS;
+  fr.ack.first_ack_blklen = 3;
+  fr.ack.num_blks = 1;
+  fr.ack.blks[0].gap = 1;
+  fr.ack.blks[0].blklen = 7;
+
+  ngtcp2_log_rx_fr(log, &hd, &fr);
+
+  if (padding) {
+    fr.padding.type = NGTCP2_FRAME_PADDING;
+    fr.padding.len = 1000;
+
+    ngtcp2_log_tx_fr(log, &hd, &fr);
+  }
+
+  ngtcp2_log_tx_pkt_hd(log, &hd);
+  ngtcp2_log_tx_cancel(log, &hd);
+  ngtcp2_log_rx_vn(log, &hd, sv, sizeof(sv) / sizeof(sv[0]));
+  ngtcp2_log_pkt_lost(log, 1000000007, NGTCP2_PKT_INITIAL,
+                      NGTCP2_PKT_FLAG_LONG_FORM, 11 * NGTCP2_MILLISECONDS);
+  ngtcp2_log_info(log, NGTCP2_LOG_EVENT_CON, "closing with %s code=%d", "NO",
+                  9);
+
+  ngtcp2_transport_params_default(&params);
+  params.initial_scid = scid;
+
+  ngtcp2_log_remote_tp(log, NGTCP2_TRANSPORT_PARAMS_TYPE_CLIENT_HELLO,
+                       &params);
+}
+
+void test_ngtcp2_log_record(void) {
+  ngtcp2_log log;
+  ngtcp2_cid scid;
+  log_sink text = {0}, rec = {0};
+
+  scid_init(&scid);
+
+  /* Structured records render into the same text as log_printf. */
+  ngtcp2_log_init(&log, &scid, log_sink_printf, NULL, 0, &text);
+  log_events(&log, /* padding = */ 0);
+
+  ngtcp2_log_init(&log, &scid, NULL, log_sink_record, 0, &rec);
+  log_events(&log, /* padding = */ 1);
+
+  CU_ASSERT(text.datalen > 0);
+  CU_ASSERT(9 == rec.nrecord);
+  CU_ASSERT(text.datalen == rec.datalen);
+  CU_ASSERT(0 == memcmp(text.data, rec.data, text.datalen));
+  CU_ASSERT(NULL == strstr(rec.data, "PADDING"));
+  CU_ASSERT(NULL != strstr(rec.data, " cry remote transport_parameters "));
+}
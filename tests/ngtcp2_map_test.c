@@ -204,3 +204,42 @@ void test_ngtcp2_map_clear(void) {
 
   ngtcp2_map_free(&map);
 }
+
+void test_ngtcp2_map_shrink(void) {
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  ngtcp2_map map;
+  size_t i;
+  uint32_t tablelen;
+
+  ngtcp2_map_init(&map, mem);
+
+  for (i = 0; i < NUM_ENT; ++i) {
+    strentry_init(&arr[i], (ngtcp2_map_key_type)(i + 1), "foo");
+
+    CU_ASSERT(0 == ngtcp2_map_insert(&map, arr[i].key, &arr[i]));
+  }
+
+  tablelen = map.tablelen;
+
+  for (i = 0; i < NUM_ENT - 1; ++i) {
+    CU_ASSERT(0 == ngtcp2_map_remove(&map, arr[i].key));
+    CU_ASSERT(map.size * 8 > map.tablelen || map.tablelen == 16);
+  }
+
+  CU_ASSERT(map.tablelen < tablelen);
+  CU_ASSERT(16 == map.tablelen);
+  CU_ASSERT(&arr[NUM_ENT - 1] == ngtcp2_map_find(&map, arr[NUM_ENT - 1].key));
+
+  /* The table grows again as usual. */
+  for (i = 0; i < NUM_ENT - 1; ++i) {
+    CU_ASSERT(0 == ngtcp2_map_insert(&map, arr[i].key, &arr[i]));
+  }
+
+  CU_ASSERT(tablelen == map.tablelen);
+
+  for (i = 0; i < NUM_ENT; ++i) {
+    CU_ASSERT(&arr[i] == ngtcp2_map_find(&map, arr[i].key));
+  }
+
+  ngtcp2_map_free(&map);
+}
@@ -34,5 +34,6 @@ void test_ngtcp2_map(void);
 void test_ngtcp2_map_functional(void);
 void test_ngtcp2_map_each_free(void);
 void test_ngtcp2_map_clear(void);
+void test_ngtcp2_map_shrink(void);
 
 #endif /* NGTCP2_MAP_TEST_H */
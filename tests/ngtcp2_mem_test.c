@@ -0,0 +1,114 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_mem_test.h"
+
+#include <CUnit/CUnit.h>
+
+#include "ngtcp2_thread_arena.h"
+#include "ngtcp2_mem.h"
+#include "ngtcp2_test_helper.h"
+
+void test_ngtcp2_thread_arena(void) {
+  ngtcp2_thread_arena *arena;
+  const ngtcp2_mem *mem;
+  uint8_t *p, *q, *r;
+  ngtcp2_thread_arena_blk *head;
+  size_t i;
+  int rv;
+
+  rv = ngtcp2_thread_arena_new(&arena, NULL);
+
+  CU_ASSERT(0 == rv);
+
+  mem = ngtcp2_thread_arena_get_mem(arena);
+
+  /* A freed object is reused by the allocation of the same size
+     class. */
+  p = ngtcp2_mem_malloc(mem, 100);
+
+  CU_ASSERT(NULL != p);
+  CU_ASSERT(0 == ((uintptr_t)p & 0xf));
+  CU_ASSERT(NULL != arena->head);
+
+  head = arena->head;
+
+  ngtcp2_mem_free(mem, p);
+  q = ngtcp2_mem_malloc(mem, 90);
+
+  CU_ASSERT(p == q);
+
+  /* calloc clears the reused object. */
+  memset(q, 0xff, 90);
+  ngtcp2_mem_free(mem, q);
+  q = ngtcp2_mem_calloc(mem, 10, 9);
+
+  CU_ASSERT(p == q);
+
+  for (i = 0; i < 90; ++i) {
+    CU_ASSERT(0 == q[i]);
+  }
+
+  /* realloc keeps the object if it still fits in its size class. */
+  r = ngtcp2_mem_realloc(mem, q, 112);
+
+  CU_ASSERT(q == r);
+
+  r = ngtcp2_mem_realloc(mem, q, 1000);
+
+  CU_ASSERT(q != r);
+  CU_ASSERT(0 == r[89]);
+
+  /* The large object is allocated from the underlying allocator. */
+  p = ngtcp2_mem_malloc(mem, NGTCP2_THREAD_ARENA_BLKLEN);
+
+  CU_ASSERT(NULL != p);
+
+  memset(p, 0x1, NGTCP2_THREAD_ARENA_BLKLEN);
+  q = ngtcp2_mem_realloc(mem, p, NGTCP2_THREAD_ARENA_BLKLEN * 2);
+
+  CU_ASSERT(NULL != q);
+  CU_ASSERT(0x1 == q[NGTCP2_THREAD_ARENA_BLKLEN - 1]);
+
+  q = ngtcp2_mem_realloc(mem, q, 10);
+
+  CU_ASSERT(NULL != q);
+  CU_ASSERT(0x1 == q[9]);
+  CU_ASSERT(head == arena->head);
+
+  ngtcp2_mem_free(mem, q);
+  ngtcp2_mem_free(mem, r);
+
+  /* A new block is obtained when the current one is exhausted. */
+  for (i = 0; i < NGTCP2_THREAD_ARENA_BLKLEN / 8192 + 1; ++i) {
+    p = ngtcp2_mem_malloc(mem, 8000);
+
+    CU_ASSERT(NULL != p);
+  }
+
+  CU_ASSERT(head != arena->head);
+  CU_ASSERT(head == arena->head->next);
+
+  ngtcp2_thread_arena_del(arena);
+}
@@ -221,6 +221,65 @@ void test_ngtcp2_pkt_decode_version_cid(void) {
   CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
 }
 
+void test_ngtcp2_pkt_group_by_dcid(void) {
+  uint8_t buf[5][32];
+  ngtcp2_vec dgrams[5];
+  ngtcp2_pkt_batch_entry ents[5];
+  uint8_t *p;
+  size_t i, ngroups;
+
+  /* Short header packets for 2 connections interleaved with an
+     undecodable datagram and a Long header packet. */
+  for (i = 0; i < 5; ++i) {
+    memset(buf[i], 0, sizeof(buf[i]));
+    buf[i][0] = NGTCP2_FIXED_BIT_MASK;
+    dgrams[i].base = buf[i];
+    dgrams[i].len = sizeof(buf[i]);
+  }
+
+  ngtcp2_setmem(&buf[0][1], 0xa1, 8);
+  ngtcp2_setmem(&buf[1][1], 0xb2, 8);
+
+  p = buf[2];
+  *p++ = NGTCP2_HEADER_FORM_BIT | NGTCP2_FIXED_BIT_MASK;
+  p = ngtcp2_put_uint32be(p, NGTCP2_PROTO_VER_V1);
+  *p++ = 8;
+  p = ngtcp2_setmem(p, 0xa1, 8);
+  *p = 0;
+
+  dgrams[3].len = 4;
+
+  ngtcp2_setmem(&buf[4][1], 0xb2, 8);
+
+  ngroups = ngtcp2_pkt_group_by_dcid(ents, dgrams, 5, 8);
+
+  CU_ASSERT(3 == ngroups);
+  CU_ASSERT(0 == ents[0].index);
+  CU_ASSERT(0 == ents[0].rv);
+  CU_ASSERT(&buf[0][1] == ents[0].vc.dcid);
+  CU_ASSERT(2 == ents[1].index);
+  CU_ASSERT(0 == ents[1].rv);
+  CU_ASSERT(NGTCP2_PROTO_VER_V1 == ents[1].vc.version);
+  CU_ASSERT(1 == ents[2].index);
+  CU_ASSERT(4 == ents[3].index);
+  CU_ASSERT(&buf[4][1] == ents[3].vc.dcid);
+  CU_ASSERT(3 == ents[4].index);
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == ents[4].rv);
+
+  /* Undecodable datagrams never form a group together. */
+  dgrams[0].len = 4;
+
+  ngroups = ngtcp2_pkt_group_by_dcid(ents, dgrams, 4, 8);
+
+  CU_ASSERT(4 == ngroups);
+
+  for (i = 0; i < 4; ++i) {
+    CU_ASSERT(i == ents[i].index);
+  }
+
+  CU_ASSERT(0 == ngtcp2_pkt_group_by_dcid(ents, dgrams, 0, 8));
+}
+
 void test_ngtcp2_pkt_decode_hd_long(void) {
   ngtcp2_pkt_hd hd, nhd;
   uint8_t buf[256];
@@ -427,6 +486,24 @@ void test_ngtcp2_pkt_decode_hd_short(void) {
   CU_ASSERT(0 == nhd.version);
   CU_ASSERT(0 == nhd.len);
 
+  /* With Spin Bit */
+  ngtcp2_pkt_hd_init(&hd, NGTCP2_PKT_FLAG_SPIN_BIT, NGTCP2_PKT_1RTT, &dcid,
+                     NULL, 0xe1e2e3e4u, 4, 0xd1d2d3d4u, 0);
+
+  expectedlen = 1 + dcid.datalen + 4;
+
+  rv = ngtcp2_pkt_encode_hd_short(buf, sizeof(buf), &hd);
+
+  CU_ASSERT((ngtcp2_ssize)expectedlen == rv);
+  CU_ASSERT(buf[0] & NGTCP2_SHORT_SPIN_BIT_MASK);
+
+  rv = pkt_decode_hd_short(&nhd, buf, expectedlen, dcid.datalen);
+
+  CU_ASSERT((ngtcp2_ssize)expectedlen == rv);
+  /* spin bit is not protected by header protection. */
+  CU_ASSERT(NGTCP2_PKT_FLAG_SPIN_BIT == nhd.flags);
+  CU_ASSERT(0xe1e2e3e4u == nhd.pkt_num);
+
   /* With empty DCID */
   ngtcp2_pkt_hd_init(&hd, NGTCP2_PKT_FLAG_NONE, NGTCP2_PKT_1RTT, NULL, NULL,
                      0xe1e2e3e4u, 4, 0xd1d2d3d4u, 0);
@@ -529,10 +606,15 @@ void test_ngtcp2_pkt_decode_stream_frame(void) {
 
 void test_ngtcp2_pkt_decode_ack_frame(void) {
   uint8_t buf[256];
+  uint8_t *p;
   size_t buflen;
   ngtcp2_frame fr;
+  ngtcp2_max_frame mfr;
   ngtcp2_ssize rv;
   size_t expectedlen;
+  ngtcp2_ack_range_it it;
+  ngtcp2_ack_blk blk;
+  uint64_t i;
 
   /* 62 bits Largest Acknowledged */
   buflen = ngtcp2_t_encode_ack_frame(buf, 0x31f2f3f4f5f6f7f8llu,
@@ -551,6 +633,48 @@ void test_ngtcp2_pkt_decode_ack_frame(void) {
   CU_ASSERT(0x31e2e3e4e5e6e7e8llu == fr.ack.first_ack_blklen);
   CU_ASSERT(99 == fr.ack.blks[0].gap);
   CU_ASSERT(0x31d2d3d4d5d6d7d8llu == fr.ack.blks[0].blklen);
+
+  /* Truncated ACK Range */
+  rv = ngtcp2_pkt_decode_ack_frame(&fr.ack, buf, buflen - 1);
+
+  CU_ASSERT(NGTCP2_ERR_FRAME_ENCODING == rv);
+
+  /* ACK Ranges beyond NGTCP2_MAX_ACK_BLKS are read from the
+     payload. */
+  p = buf;
+  *p++ = NGTCP2_FRAME_ACK;
+  p = ngtcp2_put_varint(p, 1000);
+  p = ngtcp2_put_varint(p, 0);
+  p = ngtcp2_put_varint(p, NGTCP2_MAX_ACK_BLKS + 3);
+  p = ngtcp2_put_varint(p, 0);
+
+  for (i = 0; i < NGTCP2_MAX_ACK_BLKS + 3; ++i) {
+    p = ngtcp2_put_varint(p, i);
+    p = ngtcp2_put_varint(p, 1);
+  }
+
+  buflen = (size_t)(p - buf);
+
+  rv = ngtcp2_pkt_decode_ack_frame(&mfr.ackfr.ack, buf, buflen);
+
+  CU_ASSERT((ngtcp2_ssize)buflen == rv);
+  CU_ASSERT(NGTCP2_MAX_ACK_BLKS + 3 == mfr.ackfr.ack.num_blks);
+  CU_ASSERT(0 == ngtcp2_pkt_validate_ack(&mfr.ackfr.ack));
+
+  ngtcp2_ack_range_it_init(&it, &mfr.ackfr.ack);
+
+  for (i = 0; i < NGTCP2_MAX_ACK_BLKS + 3; ++i) {
+    CU_ASSERT(ngtcp2_ack_range_it_next(&it, &blk));
+    CU_ASSERT(i == blk.gap);
+    CU_ASSERT(1 == blk.blklen);
+  }
+
+  CU_ASSERT(!ngtcp2_ack_range_it_next(&it, &blk));
+
+  /* Truncated in the ranges beyond NGTCP2_MAX_ACK_BLKS */
+  rv = ngtcp2_pkt_decode_ack_frame(&mfr.ackfr.ack, buf, buflen - 1);
+
+  CU_ASSERT(NGTCP2_ERR_FRAME_ENCODING == rv);
 }
 
 void test_ngtcp2_pkt_decode_padding_frame(void) {
@@ -1382,6 +1506,125 @@ void test_ngtcp2_pkt_encode_datagram_frame(void) {
   CU_ASSERT(NULL == nfr.datagram.data);
 }
 
+void test_ngtcp2_pkt_encode_ack_frequency_frame(void) {
+  uint8_t buf[64];
+  ngtcp2_frame fr, nfr;
+  ngtcp2_ssize rv;
+  size_t framelen;
+
+  fr.type = NGTCP2_FRAME_ACK_FREQUENCY;
+  fr.ack_frequency.seq = 1000000009;
+  fr.ack_frequency.ack_eliciting_threshold = 31;
+  fr.ack_frequency.request_max_ack_delay = 25000;
+  fr.ack_frequency.reordering_threshold = 3;
+
+  framelen = 2 + 4 + 1 + 4 + 1;
+
+  rv = ngtcp2_pkt_encode_ack_frequency_frame(buf, sizeof(buf),
+                                             &fr.ack_frequency);
+
+  CU_ASSERT((ngtcp2_ssize)framelen == rv);
+  CU_ASSERT(0x40 == buf[0]);
+  CU_ASSERT(NGTCP2_FRAME_ACK_FREQUENCY == buf[1]);
+
+  rv = ngtcp2_pkt_decode_frame(&nfr, buf, framelen);
+
+  CU_ASSERT((ngtcp2_ssize)framelen == rv);
+  CU_ASSERT(fr.type == nfr.type);
+  CU_ASSERT(fr.ack_frequency.seq == nfr.ack_frequency.seq);
+  CU_ASSERT(fr.ack_frequency.ack_eliciting_threshold ==
+            nfr.ack_frequency.ack_eliciting_threshold);
+  CU_ASSERT(fr.ack_frequency.request_max_ack_delay ==
+            nfr.ack_frequency.request_max_ack_delay);
+  CU_ASSERT(fr.ack_frequency.reordering_threshold ==
+            nfr.ack_frequency.reordering_threshold);
+
+  /* Truncated frame */
+  rv = ngtcp2_pkt_decode_frame(&nfr, buf, framelen - 1);
+
+  CU_ASSERT(NGTCP2_ERR_FRAME_ENCODING == rv);
+
+  /* Buffer is too small */
+  rv = ngtcp2_pkt_encode_ack_frequency_frame(buf, framelen - 1,
+                                             &fr.ack_frequency);
+
+  CU_ASSERT(NGTCP2_ERR_NOBUF == rv);
+}
+
+void test_ngtcp2_pkt_encode_immediate_ack_frame(void) {
+  uint8_t buf[16];
+  ngtcp2_frame fr, nfr;
+  ngtcp2_ssize rv;
+  size_t framelen = 1;
+
+  fr.type = NGTCP2_FRAME_IMMEDIATE_ACK;
+
+  rv = ngtcp2_pkt_encode_immediate_ack_frame(buf, sizeof(buf),
+                                             &fr.immediate_ack);
+
+  CU_ASSERT((ngtcp2_ssize)framelen == rv);
+
+  rv = ngtcp2_pkt_decode_frame(&nfr, buf, framelen);
+
+  CU_ASSERT((ngtcp2_ssize)framelen == rv);
+  CU_ASSERT(fr.type == nfr.type);
+}
+
+void test_ngtcp2_pkt_encode_repair_frame(void) {
+  uint8_t buf[2048];
+  uint8_t data[1200];
+  ngtcp2_frame fr, nfr;
+  ngtcp2_ssize rv;
+  size_t framelen;
+
+  memset(data, 0xa5, sizeof(data));
+
+  fr.type = NGTCP2_FRAME_REPAIR;
+  fr.repair.stream_id = 4;
+  fr.repair.offset = 1000000;
+  fr.repair.symbolcnt = 2;
+  fr.repair.symbollen[0] = 1200;
+  fr.repair.symbollen[1] = 11;
+  fr.repair.data.base = data;
+  fr.repair.data.len = sizeof(data);
+
+  framelen = 2 + 1 + 4 + 1 + 2 + 1 + sizeof(data);
+
+  rv = ngtcp2_pkt_encode_repair_frame(buf, sizeof(buf), &fr.repair);
+
+  CU_ASSERT((ngtcp2_ssize)framelen == rv);
+  CU_ASSERT(0x40 == buf[0]);
+  CU_ASSERT(NGTCP2_FRAME_REPAIR == buf[1]);
+
+  rv = ngtcp2_pkt_decode_frame(&nfr, buf, framelen);
+
+  CU_ASSERT((ngtcp2_ssize)framelen == rv);
+  CU_ASSERT(fr.type == nfr.type);
+  CU_ASSERT(fr.repair.stream_id == nfr.repair.stream_id);
+  CU_ASSERT(fr.repair.offset == nfr.repair.offset);
+  CU_ASSERT(fr.repair.symbolcnt == nfr.repair.symbolcnt);
+  CU_ASSERT(fr.repair.symbollen[0] == nfr.repair.symbollen[0]);
+  CU_ASSERT(fr.repair.symbollen[1] == nfr.repair.symbollen[1]);
+  CU_ASSERT(sizeof(data) == nfr.repair.data.len);
+  CU_ASSERT(0 == memcmp(data, nfr.repair.data.base, sizeof(data)));
+
+  /* Truncated repair data */
+  rv = ngtcp2_pkt_decode_frame(&nfr, buf, framelen - 1);
+
+  CU_ASSERT(NGTCP2_ERR_FRAME_ENCODING == rv);
+
+  /* Symbol Count is 0 */
+  buf[2 + 1 + 4] = 0;
+  rv = ngtcp2_pkt_decode_frame(&nfr, buf, framelen);
+
+  CU_ASSERT(NGTCP2_ERR_FRAME_ENCODING == rv);
+
+  /* Buffer is too small */
+  rv = ngtcp2_pkt_encode_repair_frame(buf, framelen - 1, &fr.repair);
+
+  CU_ASSERT(NGTCP2_ERR_NOBUF == rv);
+}
+
 void test_ngtcp2_pkt_adjust_pkt_num(void) {
   CU_ASSERT(0xaa831f94llu ==
             ngtcp2_pkt_adjust_pkt_num(0xaa82f30ellu, 0x1f94, 16));
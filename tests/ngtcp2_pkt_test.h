@@ -30,6 +30,7 @@
 #endif /* HAVE_CONFIG_H */
 
 void test_ngtcp2_pkt_decode_version_cid(void);
+void test_ngtcp2_pkt_group_by_dcid(void);
 void test_ngtcp2_pkt_decode_hd_long(void);
 void test_ngtcp2_pkt_decode_hd_short(void);
 void test_ngtcp2_pkt_decode_stream_frame(void);
@@ -58,6 +59,9 @@ void test_ngtcp2_pkt_encode_new_token_frame(void);
 void test_ngtcp2_pkt_encode_retire_connection_id_frame(void);
 void test_ngtcp2_pkt_encode_handshake_done_frame(void);
 void test_ngtcp2_pkt_encode_datagram_frame(void);
+void test_ngtcp2_pkt_encode_ack_frequency_frame(void);
+void test_ngtcp2_pkt_encode_immediate_ack_frame(void);
+void test_ngtcp2_pkt_encode_repair_frame(void);
 void test_ngtcp2_pkt_adjust_pkt_num(void);
 void test_ngtcp2_pkt_validate_ack(void);
 void test_ngtcp2_pkt_write_stateless_reset(void);
@@ -35,7 +35,8 @@ void test_ngtcp2_pmtud_probe(void) {
   int rv;
 
   /* Send probe and get success */
-  rv = ngtcp2_pmtud_new(&pmtud, NGTCP2_MAX_UDP_PAYLOAD_SIZE, 1452, 0, mem);
+  rv = ngtcp2_pmtud_new(&pmtud, NGTCP2_MAX_UDP_PAYLOAD_SIZE, 1452, 0,
+                        NGTCP2_PMTUD_FLAG_NONE, mem);
 
   CU_ASSERT(0 == rv);
   CU_ASSERT(0 == pmtud->mtu_idx);
@@ -94,7 +95,8 @@ void test_ngtcp2_pmtud_probe(void) {
   ngtcp2_pmtud_del(pmtud);
 
   /* Failing 2nd probe should skip the third probe */
-  rv = ngtcp2_pmtud_new(&pmtud, NGTCP2_MAX_UDP_PAYLOAD_SIZE, 1452, 0, mem);
+  rv = ngtcp2_pmtud_new(&pmtud, NGTCP2_MAX_UDP_PAYLOAD_SIZE, 1452, 0,
+                        NGTCP2_PMTUD_FLAG_NONE, mem);
 
   ngtcp2_pmtud_probe_sent(pmtud, 2, 0);
   ngtcp2_pmtud_handle_expiry(pmtud, 2);
@@ -125,7 +127,7 @@ void test_ngtcp2_pmtud_probe(void) {
 
   /* Skip 1st probe because it is larger than hard max. */
   rv = ngtcp2_pmtud_new(&pmtud, NGTCP2_MAX_UDP_PAYLOAD_SIZE, 1454 - 48 - 1, 0,
-                        mem);
+                        NGTCP2_PMTUD_FLAG_NONE, mem);
 
   CU_ASSERT(0 == rv);
   CU_ASSERT(1 == pmtud->mtu_idx);
@@ -134,7 +136,8 @@ void test_ngtcp2_pmtud_probe(void) {
 
   /* PMTUD finishes immediately because we know that all candidates
      are lower than the current maximum. */
-  rv = ngtcp2_pmtud_new(&pmtud, 1492 - 48, 1452, 0, mem);
+  rv = ngtcp2_pmtud_new(&pmtud, 1492 - 48, 1452, 0, NGTCP2_PMTUD_FLAG_NONE,
+                        mem);
 
   CU_ASSERT(0 == rv);
   CU_ASSERT(ngtcp2_pmtud_finished(pmtud));
@@ -144,7 +147,115 @@ void test_ngtcp2_pmtud_probe(void) {
   /* PMTUD finishes immediately because the hard maximum size is lower
      than the candidates. */
   rv = ngtcp2_pmtud_new(&pmtud, NGTCP2_MAX_UDP_PAYLOAD_SIZE,
-                        NGTCP2_MAX_UDP_PAYLOAD_SIZE, 0, mem);
+                        NGTCP2_MAX_UDP_PAYLOAD_SIZE, 0, NGTCP2_PMTUD_FLAG_NONE,
+                        mem);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(ngtcp2_pmtud_finished(pmtud));
+
+  ngtcp2_pmtud_del(pmtud);
+}
+
+static void pmtud_fail_probe(ngtcp2_pmtud *pmtud, ngtcp2_tstamp *pts) {
+  size_t i;
+
+  for (i = 0; i < 3; ++i) {
+    ngtcp2_pmtud_probe_sent(pmtud, 2, *pts);
+    *pts = pmtud->expiry;
+    ngtcp2_pmtud_handle_expiry(pmtud, *pts);
+  }
+}
+
+void test_ngtcp2_pmtud_search(void) {
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  ngtcp2_pmtud *pmtud;
+  ngtcp2_tstamp t = 0;
+  int rv;
+
+  /* Ethernet and jumbo frame MTUs are tried first, and then bisect
+     up to 65527. */
+  rv = ngtcp2_pmtud_new(&pmtud, NGTCP2_MAX_UDP_PAYLOAD_SIZE, 65535, 0,
+                        NGTCP2_PMTUD_FLAG_SEARCH, mem);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(65527 == pmtud->hard_max_udp_payload_size);
+  CU_ASSERT(!ngtcp2_pmtud_finished(pmtud));
+  CU_ASSERT(1500 - 48 == ngtcp2_pmtud_probelen(pmtud));
+
+  ngtcp2_pmtud_probe_sent(pmtud, 2, t);
+  ngtcp2_pmtud_probe_success(pmtud, ngtcp2_pmtud_probelen(pmtud));
+
+  CU_ASSERT(1500 - 48 == pmtud->max_udp_payload_size);
+  CU_ASSERT(ngtcp2_pmtud_require_probe(pmtud));
+  CU_ASSERT(9000 - 48 == ngtcp2_pmtud_probelen(pmtud));
+
+  ngtcp2_pmtud_probe_sent(pmtud, 2, t);
+  ngtcp2_pmtud_probe_success(pmtud, ngtcp2_pmtud_probelen(pmtud));
+
+  CU_ASSERT(9000 - 48 == pmtud->max_udp_payload_size);
+  CU_ASSERT(9000 - 48 + (65527 - (9000 - 48) + 1) / 2 ==
+            ngtcp2_pmtud_probelen(pmtud));
+
+  pmtud_fail_probe(pmtud, &t);
+
+  CU_ASSERT(9000 - 48 + (65527 - (9000 - 48) + 1) / 2 ==
+            pmtud->min_fail_udp_payload_size);
+  CU_ASSERT(9000 - 48 + (pmtud->min_fail_udp_payload_size - 1 -
+                         (9000 - 48) + 1) /
+                            2 ==
+            ngtcp2_pmtud_probelen(pmtud));
+
+  while (!ngtcp2_pmtud_finished(pmtud)) {
+    pmtud_fail_probe(pmtud, &t);
+  }
+
+  CU_ASSERT(9000 - 48 == pmtud->max_udp_payload_size);
+  CU_ASSERT(pmtud->min_fail_udp_payload_size > 9000 - 48);
+  CU_ASSERT(pmtud->min_fail_udp_payload_size - 1 - (9000 - 48) < 16);
+
+  ngtcp2_pmtud_del(pmtud);
+
+  /* Jumbo frame is dropped. */
+  rv = ngtcp2_pmtud_new(&pmtud, 1500 - 48, 65527, 0, NGTCP2_PMTUD_FLAG_SEARCH,
+                        mem);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(9000 - 48 == ngtcp2_pmtud_probelen(pmtud));
+
+  pmtud_fail_probe(pmtud, &t);
+
+  CU_ASSERT(1500 - 48 + (9000 - 48 - 1 - (1500 - 48) + 1) / 2 ==
+            ngtcp2_pmtud_probelen(pmtud));
+
+  /* The acknowledgement of a smaller packet raises the lower bound,
+     but the current probe is still outstanding. */
+  ngtcp2_pmtud_probe_success(pmtud, 4000);
+
+  CU_ASSERT(4000 == pmtud->max_udp_payload_size);
+  CU_ASSERT(1500 - 48 + (9000 - 48 - 1 - (1500 - 48) + 1) / 2 ==
+            ngtcp2_pmtud_probelen(pmtud));
+
+  ngtcp2_pmtud_probe_success(pmtud, ngtcp2_pmtud_probelen(pmtud));
+
+  CU_ASSERT(5202 == pmtud->max_udp_payload_size);
+  CU_ASSERT(5202 + (9000 - 48 - 1 - 5202 + 1) / 2 ==
+            ngtcp2_pmtud_probelen(pmtud));
+
+  ngtcp2_pmtud_del(pmtud);
+
+  /* Search finishes immediately if hard maximum is the jumbo frame
+     MTU which is known to work. */
+  rv = ngtcp2_pmtud_new(&pmtud, 9000 - 48, 9000 - 48, 0,
+                        NGTCP2_PMTUD_FLAG_SEARCH, mem);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(ngtcp2_pmtud_finished(pmtud));
+
+  ngtcp2_pmtud_del(pmtud);
+
+  /* Range narrower than the granularity is not searched. */
+  rv = ngtcp2_pmtud_new(&pmtud, 1500 - 48, 1500 - 48 + 15, 0,
+                        NGTCP2_PMTUD_FLAG_SEARCH, mem);
 
   CU_ASSERT(0 == rv);
   CU_ASSERT(ngtcp2_pmtud_finished(pmtud));
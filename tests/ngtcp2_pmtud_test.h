@@ -30,5 +30,6 @@
 #endif /* HAVE_CONFIG_H */
 
 void test_ngtcp2_pmtud_probe(void);
+void test_ngtcp2_pmtud_search(void);
 
 #endif /* NGTCP2_PMTUD_TEST_H */
@@ -0,0 +1,397 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_ppe_test.h"
+
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+
+#include "ngtcp2_ppe.h"
+#include "ngtcp2_test_helper.h"
+#include "ngtcp2_cid.h"
+#include "ngtcp2_vec.h"
+#include "ngtcp2_str.h"
+
+void test_ngtcp2_ppe_encode_hd_tmpl(void) {
+  ngtcp2_ppe ppe;
+  ngtcp2_ppe_hd_tmpl tmpl = {0};
+  ngtcp2_crypto_cc cc = {0};
+  ngtcp2_pkt_hd hd;
+  ngtcp2_cid dcid, scid;
+  uint8_t buf[256], expected[256];
+  ngtcp2_ssize expectedlen;
+  int rv;
+
+  dcid_init(&dcid);
+  scid_init(&scid);
+
+  cc.aead.max_overhead = NGTCP2_FAKE_AEAD_OVERHEAD;
+
+  /* Nothing is cached yet */
+  ngtcp2_pkt_hd_init(&hd, NGTCP2_PKT_FLAG_NONE, NGTCP2_PKT_1RTT, &dcid, NULL,
+                     0xe1e2e3e4u, 4, 0, 0);
+
+  expectedlen = ngtcp2_pkt_encode_hd_short(expected, sizeof(expected), &hd);
+
+  ngtcp2_ppe_init(&ppe, buf, sizeof(buf), &cc);
+  rv = ngtcp2_ppe_encode_hd_tmpl(&ppe, &tmpl, &hd);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT((size_t)expectedlen == ppe.hdlen);
+  CU_ASSERT(0 == memcmp(expected, buf, (size_t)expectedlen));
+  CU_ASSERT(1 + dcid.datalen == tmpl.len);
+
+  /* The cached header only gets packet number */
+  hd.pkt_num = 0xe1e2e3e5u;
+
+  expectedlen = ngtcp2_pkt_encode_hd_short(expected, sizeof(expected), &hd);
+
+  ngtcp2_ppe_init(&ppe, buf, sizeof(buf), &cc);
+  rv = ngtcp2_ppe_encode_hd_tmpl(&ppe, &tmpl, &hd);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT((size_t)expectedlen == ppe.hdlen);
+  CU_ASSERT((size_t)expectedlen == ngtcp2_buf_len(&ppe.buf));
+  CU_ASSERT(1 + dcid.datalen == ppe.pkt_num_offset);
+  CU_ASSERT(ppe.pkt_num_offset + 4 == ppe.sample_offset);
+  CU_ASSERT(4 == ppe.pkt_numlen);
+  CU_ASSERT(0xe1e2e3e5u == ppe.pkt_num);
+  CU_ASSERT(0 == memcmp(expected, buf, (size_t)expectedlen));
+
+  /* Key phase change rebuilds the header */
+  ngtcp2_pkt_hd_init(&hd, NGTCP2_PKT_FLAG_KEY_PHASE, NGTCP2_PKT_1RTT, &dcid,
+                     NULL, 0xe1e2e3e6u, 4, 0, 0);
+
+  expectedlen = ngtcp2_pkt_encode_hd_short(expected, sizeof(expected), &hd);
+
+  ngtcp2_ppe_init(&ppe, buf, sizeof(buf), &cc);
+  rv = ngtcp2_ppe_encode_hd_tmpl(&ppe, &tmpl, &hd);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == memcmp(expected, buf, (size_t)expectedlen));
+  CU_ASSERT(NGTCP2_PKT_FLAG_KEY_PHASE == tmpl.flags);
+
+  /* Packet number length change rebuilds the header */
+  ngtcp2_pkt_hd_init(&hd, NGTCP2_PKT_FLAG_KEY_PHASE, NGTCP2_PKT_1RTT, &dcid,
+                     NULL, 0xe1e2e3e7u, 2, 0, 0);
+
+  expectedlen = ngtcp2_pkt_encode_hd_short(expected, sizeof(expected), &hd);
+
+  ngtcp2_ppe_init(&ppe, buf, sizeof(buf), &cc);
+  rv = ngtcp2_ppe_encode_hd_tmpl(&ppe, &tmpl, &hd);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT((size_t)expectedlen == ppe.hdlen);
+  CU_ASSERT(0 == memcmp(expected, buf, (size_t)expectedlen));
+  CU_ASSERT(2 == tmpl.pkt_numlen);
+
+  /* Destination Connection ID change rebuilds the header */
+  ngtcp2_pkt_hd_init(&hd, NGTCP2_PKT_FLAG_KEY_PHASE, NGTCP2_PKT_1RTT, &scid,
+                     NULL, 0xe1e2e3e8u, 2, 0, 0);
+
+  expectedlen = ngtcp2_pkt_encode_hd_short(expected, sizeof(expected), &hd);
+
+  ngtcp2_ppe_init(&ppe, buf, sizeof(buf), &cc);
+  rv = ngtcp2_ppe_encode_hd_tmpl(&ppe, &tmpl, &hd);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == memcmp(expected, buf, (size_t)expectedlen));
+  CU_ASSERT(ngtcp2_cid_eq(&scid, &tmpl.dcid));
+
+  /* The cached header does not fit in the buffer */
+  hd.pkt_num = 0xe1e2e3e9u;
+
+  ngtcp2_ppe_init(&ppe, buf,
+                  (size_t)expectedlen + NGTCP2_FAKE_AEAD_OVERHEAD - 1, &cc);
+  rv = ngtcp2_ppe_encode_hd_tmpl(&ppe, &tmpl, &hd);
+
+  CU_ASSERT(NGTCP2_ERR_NOBUF == rv);
+
+  ngtcp2_ppe_init(&ppe, buf, (size_t)expectedlen + NGTCP2_FAKE_AEAD_OVERHEAD,
+                  &cc);
+  rv = ngtcp2_ppe_encode_hd_tmpl(&ppe, &tmpl, &hd);
+
+  CU_ASSERT(0 == rv);
+}
+
+static int xor_encrypt(uint8_t *dest, const ngtcp2_crypto_aead *aead,
+                       const ngtcp2_crypto_aead_ctx *aead_ctx,
+                       const uint8_t *plaintext, size_t plaintextlen,
+                       const uint8_t *nonce, size_t noncelen,
+                       const uint8_t *aad, size_t aadlen) {
+  size_t i;
+  (void)aead;
+  (void)aead_ctx;
+  (void)aad;
+  (void)aadlen;
+
+  for (i = 0; i < plaintextlen; ++i) {
+    dest[i] = (uint8_t)(plaintext[i] ^ nonce[i % noncelen]);
+  }
+
+  memset(dest + plaintextlen, 0xff, NGTCP2_FAKE_AEAD_OVERHEAD);
+
+  return 0;
+}
+
+static int xor_hp_mask(uint8_t *dest, const ngtcp2_crypto_cipher *hp,
+                       const ngtcp2_crypto_cipher_ctx *hp_ctx,
+                       const uint8_t *sample) {
+  size_t i;
+  (void)hp;
+  (void)hp_ctx;
+
+  for (i = 0; i < NGTCP2_HP_SAMPLELEN; ++i) {
+    dest[i] = (uint8_t)(sample[i] ^ (i + 1));
+  }
+
+  return 0;
+}
+
+static size_t encrypt_hp_mask_ncalls;
+
+static int xor_encrypt_hp_mask(
+    uint8_t *dest, uint8_t *mask, const ngtcp2_crypto_aead *aead,
+    const ngtcp2_crypto_aead_ctx *aead_ctx, const uint8_t *plaintext,
+    size_t plaintextlen, const uint8_t *nonce, size_t noncelen,
+    const uint8_t *aad, size_t aadlen, const ngtcp2_crypto_cipher *hp,
+    const ngtcp2_crypto_cipher_ctx *hp_ctx, size_t sample_offset) {
+  ++encrypt_hp_mask_ncalls;
+
+  xor_encrypt(dest, aead, aead_ctx, plaintext, plaintextlen, nonce, noncelen,
+              aad, aadlen);
+
+  return xor_hp_mask(mask, hp, hp_ctx, dest + sample_offset);
+}
+
+static ngtcp2_ssize write_ping_pkt(uint8_t *out, size_t outlen,
+                                   ngtcp2_crypto_cc *cc) {
+  ngtcp2_ppe ppe;
+  ngtcp2_pkt_hd hd;
+  ngtcp2_cid dcid;
+  ngtcp2_frame fr;
+  int rv;
+
+  dcid_init(&dcid);
+
+  ngtcp2_pkt_hd_init(&hd, NGTCP2_PKT_FLAG_NONE, NGTCP2_PKT_1RTT, &dcid, NULL,
+                     0xe1e2e3e4u, 2, 0, 0);
+
+  ngtcp2_ppe_init(&ppe, out, outlen, cc);
+  rv = ngtcp2_ppe_encode_hd(&ppe, &hd);
+
+  CU_ASSERT(0 == rv);
+
+  fr.type = NGTCP2_FRAME_PING;
+  rv = ngtcp2_ppe_encode_frame(&ppe, &fr);
+
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_ppe_padding_hp_sample(&ppe);
+
+  return ngtcp2_ppe_final(&ppe, NULL);
+}
+
+void test_ngtcp2_ppe_final_encrypt_hp_mask(void) {
+  ngtcp2_crypto_cc cc = {0};
+  ngtcp2_crypto_km ckm = {0};
+  uint8_t iv[12] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+                    0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c};
+  uint8_t expected[256], buf[256];
+  ngtcp2_ssize expectedlen, spktlen;
+
+  ngtcp2_vec_init(&ckm.iv, iv, sizeof(iv));
+
+  cc.aead.max_overhead = NGTCP2_FAKE_AEAD_OVERHEAD;
+  cc.ckm = &ckm;
+  cc.encrypt = xor_encrypt;
+  cc.hp_mask = xor_hp_mask;
+
+  expectedlen = write_ping_pkt(expected, sizeof(expected), &cc);
+
+  CU_ASSERT(expectedlen > 0);
+
+  /* The combined callback takes the sample from the ciphertext it
+     writes and produces the same packet. */
+  cc.encrypt_hp_mask = xor_encrypt_hp_mask;
+  encrypt_hp_mask_ncalls = 0;
+
+  spktlen = write_ping_pkt(buf, sizeof(buf), &cc);
+
+  CU_ASSERT(expectedlen == spktlen);
+  CU_ASSERT(0 == memcmp(expected, buf, (size_t)spktlen));
+  CU_ASSERT(1 == encrypt_hp_mask_ncalls);
+}
+
+static size_t encrypt_vec_ncalls;
+static const uint8_t *encrypt_vec_extdata;
+
+static int xor_encrypt_vec(uint8_t *dest, const ngtcp2_crypto_aead *aead,
+                           const ngtcp2_crypto_aead_ctx *aead_ctx,
+                           const ngtcp2_vec *plaintext, size_t plaintextcnt,
+                           const uint8_t *nonce, size_t noncelen,
+                           const uint8_t *aad, size_t aadlen) {
+  uint8_t buf[256];
+  uint8_t *p = buf;
+  size_t i;
+
+  ++encrypt_vec_ncalls;
+
+  for (i = 0; i < plaintextcnt; ++i) {
+    if (plaintext[i].base == encrypt_vec_extdata) {
+      encrypt_vec_extdata = NULL;
+    }
+
+    p = ngtcp2_cpymem(p, plaintext[i].base, plaintext[i].len);
+  }
+
+  return xor_encrypt(dest, aead, aead_ctx, buf, (size_t)(p - buf), nonce,
+                     noncelen, aad, aadlen);
+}
+
+static ngtcp2_ssize write_stream_pkt(uint8_t *out, size_t outlen,
+                                     ngtcp2_crypto_cc *cc,
+                                     const uint8_t *data, size_t datalen,
+                                     int deferred) {
+  ngtcp2_ppe ppe;
+  ngtcp2_pkt_hd hd;
+  ngtcp2_cid dcid;
+  ngtcp2_frame fr;
+  ngtcp2_vec vec;
+  ngtcp2_ppe_deferred dpkt;
+  ngtcp2_ppe_batch batch;
+  int rv;
+
+  dcid_init(&dcid);
+
+  ngtcp2_pkt_hd_init(&hd, NGTCP2_PKT_FLAG_NONE, NGTCP2_PKT_1RTT, &dcid, NULL,
+                     0xe1e2e3e4u, 2, 0, 0);
+
+  ngtcp2_ppe_init(&ppe, out, outlen, cc);
+  rv = ngtcp2_ppe_encode_hd(&ppe, &hd);
+
+  CU_ASSERT(0 == rv);
+
+  fr.type = NGTCP2_FRAME_PING;
+  rv = ngtcp2_ppe_encode_frame(&ppe, &fr);
+
+  CU_ASSERT(0 == rv);
+
+  vec.base = (uint8_t *)data;
+  vec.len = datalen;
+
+  fr.stream.type = NGTCP2_FRAME_STREAM;
+  fr.stream.flags = 0;
+  fr.stream.fin = 1;
+  fr.stream.stream_id = 4;
+  fr.stream.offset = 1000000007;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0] = vec;
+
+  rv = ngtcp2_ppe_encode_frame(&ppe, &fr);
+
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_ppe_padding_size(&ppe, 100);
+
+  if (!deferred) {
+    return ngtcp2_ppe_final(&ppe, NULL);
+  }
+
+  ngtcp2_ppe_final_deferred(&ppe, &dpkt);
+
+  /* The stream data must have been copied into the packet. */
+  CU_ASSERT(0 == ppe.extcnt);
+
+  rv = ngtcp2_ppe_protect_deferred(cc, NULL, NULL, &batch, &dpkt, 1);
+
+  CU_ASSERT(0 == rv);
+
+  return (ngtcp2_ssize)ngtcp2_buf_len(&ppe.buf);
+}
+
+void test_ngtcp2_ppe_final_encrypt_vec(void) {
+  ngtcp2_crypto_cc cc = {0};
+  ngtcp2_crypto_km ckm = {0};
+  uint8_t iv[12] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+                    0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c};
+  uint8_t expected[256], buf[256];
+  uint8_t data[77];
+  ngtcp2_ssize expectedlen, spktlen;
+  size_t i;
+
+  for (i = 0; i < sizeof(data); ++i) {
+    data[i] = (uint8_t)i;
+  }
+
+  ngtcp2_vec_init(&ckm.iv, iv, sizeof(iv));
+
+  cc.aead.max_overhead = NGTCP2_FAKE_AEAD_OVERHEAD;
+  cc.ckm = &ckm;
+  cc.encrypt = xor_encrypt;
+  cc.hp_mask = xor_hp_mask;
+
+  expectedlen =
+      write_stream_pkt(expected, sizeof(expected), &cc, data, sizeof(data), 0);
+
+  CU_ASSERT(expectedlen > 0);
+
+  /* STREAM data is passed to encrypt_vec without copying. */
+  cc.encrypt_vec = xor_encrypt_vec;
+  encrypt_vec_ncalls = 0;
+  encrypt_vec_extdata = data;
+  memset(buf, 0, sizeof(buf));
+
+  spktlen = write_stream_pkt(buf, sizeof(buf), &cc, data, sizeof(data), 0);
+
+  CU_ASSERT(expectedlen == spktlen);
+  CU_ASSERT(0 == memcmp(expected, buf, (size_t)spktlen));
+  CU_ASSERT(1 == encrypt_vec_ncalls);
+  CU_ASSERT(NULL == encrypt_vec_extdata);
+
+  /* encrypt_vec takes precedence over encrypt_hp_mask. */
+  cc.encrypt_hp_mask = xor_encrypt_hp_mask;
+  encrypt_vec_ncalls = 0;
+  encrypt_hp_mask_ncalls = 0;
+  memset(buf, 0, sizeof(buf));
+
+  spktlen = write_stream_pkt(buf, sizeof(buf), &cc, data, sizeof(data), 0);
+
+  CU_ASSERT(expectedlen == spktlen);
+  CU_ASSERT(0 == memcmp(expected, buf, (size_t)spktlen));
+  CU_ASSERT(1 == encrypt_vec_ncalls);
+  CU_ASSERT(0 == encrypt_hp_mask_ncalls);
+
+  /* Deferred protection copies STREAM data. */
+  cc.encrypt_hp_mask = NULL;
+  encrypt_vec_ncalls = 0;
+  memset(buf, 0, sizeof(buf));
+
+  spktlen = write_stream_pkt(buf, sizeof(buf), &cc, data, sizeof(data), 1);
+
+  CU_ASSERT(expectedlen == spktlen);
+  CU_ASSERT(0 == memcmp(expected, buf, (size_t)spktlen));
+  CU_ASSERT(0 == encrypt_vec_ncalls);
+}
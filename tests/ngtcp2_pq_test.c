@@ -0,0 +1,88 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_pq_test.h"
+
+#include <CUnit/CUnit.h>
+
+#include "ngtcp2_pq.h"
+#include "ngtcp2_macro.h"
+#include "ngtcp2_test_helper.h"
+
+typedef struct pq_item {
+  ngtcp2_pq_entry pe;
+  uint64_t key;
+} pq_item;
+
+static int pq_item_less(const ngtcp2_pq_entry *lhs,
+                        const ngtcp2_pq_entry *rhs) {
+  return ngtcp2_struct_of(lhs, pq_item, pe)->key <
+         ngtcp2_struct_of(rhs, pq_item, pe)->key;
+}
+
+void test_ngtcp2_pq_arity(void) {
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  const size_t arities[] = {2, 4, 8};
+  pq_item items[257];
+  ngtcp2_pq pq;
+  pq_item *item;
+  size_t i, j;
+  uint64_t last;
+  int rv;
+
+  for (j = 0; j < arraylen(arities); ++j) {
+    ngtcp2_pq_init_arity(&pq, pq_item_less, arities[j], mem);
+
+    for (i = 0; i < arraylen(items); ++i) {
+      items[i].key = (i * 97) % arraylen(items);
+
+      rv = ngtcp2_pq_push(&pq, &items[i].pe);
+
+      CU_ASSERT(0 == rv);
+    }
+
+    /* Remove the items of odd key from the middle of the heap. */
+    for (i = 0; i < arraylen(items); ++i) {
+      if (items[i].key % 2) {
+        ngtcp2_pq_remove(&pq, &items[i].pe);
+      }
+    }
+
+    CU_ASSERT(129 == ngtcp2_pq_size(&pq));
+
+    for (last = 0; !ngtcp2_pq_empty(&pq);) {
+      item = ngtcp2_struct_of(ngtcp2_pq_top(&pq), pq_item, pe);
+
+      CU_ASSERT(last <= item->key);
+      CU_ASSERT(0 == item->key % 2);
+
+      last = item->key;
+      ngtcp2_pq_pop(&pq);
+    }
+
+    CU_ASSERT(256 == last);
+
+    ngtcp2_pq_free(&pq);
+  }
+}
@@ -43,7 +43,7 @@ void test_ngtcp2_pv_add_entry(void) {
 
   dcid_init(&cid);
   ngtcp2_dcid_init(&dcid, 1000000007, &cid, token);
-  ngtcp2_log_init(&log, NULL, NULL, 0, NULL);
+  ngtcp2_log_init(&log, NULL, NULL, NULL, 0, NULL);
 
   rv = ngtcp2_pv_new(&pv, &dcid, timeout, NGTCP2_PV_FLAG_NONE, &log, mem);
 
@@ -103,7 +103,7 @@ void test_ngtcp2_pv_validate(void) {
   dcid_init(&cid);
   ngtcp2_dcid_init(&dcid, 1000000007, &cid, token);
   ngtcp2_path_copy(&dcid.ps.path, &path.path);
-  ngtcp2_log_init(&log, NULL, NULL, 0, NULL);
+  ngtcp2_log_init(&log, NULL, NULL, NULL, 0, NULL);
 
   rv = ngtcp2_pv_new(&pv, &dcid, timeout, NGTCP2_PV_FLAG_NONE, &log, mem);
 
@@ -116,12 +116,15 @@ void test_ngtcp2_pv_validate(void) {
   ngtcp2_pv_add_entry(pv, data, 100, NGTCP2_PV_ENTRY_FLAG_NONE, 1);
 
   memset(data, 1, sizeof(data));
-  rv = ngtcp2_pv_validate(pv, &flags, data);
+  rv = ngtcp2_pv_validate(pv, &flags, data, 11);
 
   CU_ASSERT(0 == rv);
+  CU_ASSERT(10 == pv->dcid.latest_rtt);
+  CU_ASSERT(10 == pv->dcid.smoothed_rtt);
+  CU_ASSERT(11 == pv->dcid.validated_ts);
 
   memset(data, 3, sizeof(data));
-  rv = ngtcp2_pv_validate(pv, &flags, data);
+  rv = ngtcp2_pv_validate(pv, &flags, data, 11);
 
   CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
 
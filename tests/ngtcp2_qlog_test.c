@@ -0,0 +1,300 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2022 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_qlog_test.h"
+
+#include <CUnit/CUnit.h>
+
+#include "ngtcp2_qlog.h"
+#include "ngtcp2_conv.h"
+#include "ngtcp2_test_helper.h"
+
+typedef struct {
+  uint8_t data[1024];
+  size_t datalen;
+  size_t nwrite;
+} qlog_bin_sink;
+
+static void qlog_bin_write(void *user_data, uint32_t flags, const void *data,
+                           size_t datalen) {
+  qlog_bin_sink *sink = user_data;
+  (void)flags;
+
+  memcpy(sink->data + sink->datalen, data, datalen);
+  sink->datalen += datalen;
+  ++sink->nwrite;
+}
+
+static uint64_t qlog_bin_get_varint(const uint8_t **pp) {
+  size_t n;
+  uint64_t v = ngtcp2_get_varint(&n, *pp);
+
+  *pp += n;
+
+  return v;
+}
+
+void test_ngtcp2_qlog_binary(void) {
+  ngtcp2_qlog qlog;
+  ngtcp2_qlog_settings qs;
+  qlog_bin_sink sink = {0};
+  uint8_t buf[NGTCP2_QLOG_BUFLEN];
+  ngtcp2_cid odcid;
+  ngtcp2_frame fr;
+  ngtcp2_pkt_hd hd;
+  ngtcp2_conn_stat cstat = {0};
+  const uint8_t *p, *body;
+  uint64_t bodylen, frameslen;
+  uint8_t data[1200];
+
+  dcid_init(&odcid);
+
+  memset(&qs, 0, sizeof(qs));
+  qs.write = qlog_bin_write;
+  qs.format = NGTCP2_QLOG_FORMAT_BINARY;
+
+  ngtcp2_qlog_init(&qlog, &qs, 1000000, &sink);
+  ngtcp2_buf_init(&qlog.buf, buf, sizeof(buf));
+
+  ngtcp2_qlog_start(&qlog, &odcid, /* server = */ 1);
+
+  p = sink.data;
+
+  CU_ASSERT(0 == memcmp(NGTCP2_QLOG_BIN_MAGIC, p, 4));
+
+  p += 4;
+
+  CU_ASSERT(NGTCP2_QLOG_BIN_VERSION == qlog_bin_get_varint(&p));
+  CU_ASSERT(1 == qlog_bin_get_varint(&p));
+  CU_ASSERT(odcid.datalen == qlog_bin_get_varint(&p));
+  CU_ASSERT(0 == memcmp(odcid.data, p, odcid.datalen));
+
+  p += odcid.datalen;
+
+  CU_ASSERT(sink.data + sink.datalen == p);
+
+  /* packet_sent with PING and STREAM frames */
+  qlog.last_ts = 1000000 + 3 * NGTCP2_MILLISECONDS;
+
+  ngtcp2_qlog_pkt_sent_start(&qlog);
+
+  fr.type = NGTCP2_FRAME_PING;
+  ngtcp2_qlog_write_frame(&qlog, &fr);
+
+  fr.stream.type = NGTCP2_FRAME_STREAM;
+  fr.stream.fin = 1;
+  fr.stream.stream_id = 4;
+  fr.stream.offset = 1000000;
+  fr.stream.datacnt = 1;
+  fr.stream.data[0].base = data;
+  fr.stream.data[0].len = sizeof(data);
+  ngtcp2_qlog_write_frame(&qlog, &fr);
+
+  memset(&hd, 0, sizeof(hd));
+  hd.type = NGTCP2_PKT_1RTT;
+  hd.pkt_num = 1000000007;
+
+  ngtcp2_qlog_pkt_sent_end(&qlog, &hd, 1252);
+
+  CU_ASSERT(2 == sink.nwrite);
+  CU_ASSERT(NGTCP2_QLOG_BIN_EVENT_PKT_SENT == qlog_bin_get_varint(&p));
+  CU_ASSERT(3 * NGTCP2_MILLISECONDS == qlog_bin_get_varint(&p));
+
+  bodylen = qlog_bin_get_varint(&p);
+
+  CU_ASSERT(sink.data + sink.datalen == p + bodylen);
+
+  frameslen = qlog_bin_get_varint(&p);
+  body = p;
+
+  CU_ASSERT(NGTCP2_FRAME_PING == qlog_bin_get_varint(&p));
+  CU_ASSERT(NGTCP2_FRAME_STREAM == qlog_bin_get_varint(&p));
+  CU_ASSERT(1 == qlog_bin_get_varint(&p));
+  CU_ASSERT(4 == qlog_bin_get_varint(&p));
+  CU_ASSERT(1000000 == qlog_bin_get_varint(&p));
+  CU_ASSERT(1200 == qlog_bin_get_varint(&p));
+  CU_ASSERT(body + frameslen == p);
+  CU_ASSERT(NGTCP2_QLOG_BIN_PKT_TYPE_1RTT == qlog_bin_get_varint(&p));
+  CU_ASSERT(1000000007 == qlog_bin_get_varint(&p));
+  CU_ASSERT(0 == qlog_bin_get_varint(&p));
+  CU_ASSERT(1252 == qlog_bin_get_varint(&p));
+  CU_ASSERT(sink.data + sink.datalen == p);
+
+  /* metrics_updated without min_rtt and ssthresh */
+  cstat.min_rtt = UINT64_MAX;
+  cstat.ssthresh = UINT64_MAX;
+  cstat.smoothed_rtt = 333 * NGTCP2_MILLISECONDS;
+  cstat.cwnd = 12000;
+
+  ngtcp2_qlog_metrics_updated(&qlog, &cstat);
+
+  CU_ASSERT(NGTCP2_QLOG_BIN_EVENT_METRICS_UPDATED == qlog_bin_get_varint(&p));
+  CU_ASSERT(0 == qlog_bin_get_varint(&p));
+
+  bodylen = qlog_bin_get_varint(&p);
+
+  CU_ASSERT(sink.data + sink.datalen == p + bodylen);
+  CU_ASSERT(0 == qlog_bin_get_varint(&p));
+  CU_ASSERT(333 * NGTCP2_MILLISECONDS == qlog_bin_get_varint(&p));
+  CU_ASSERT(0 == qlog_bin_get_varint(&p));
+  CU_ASSERT(0 == qlog_bin_get_varint(&p));
+  CU_ASSERT(0 == qlog_bin_get_varint(&p));
+  CU_ASSERT(12000 == qlog_bin_get_varint(&p));
+  CU_ASSERT(0 == qlog_bin_get_varint(&p));
+  CU_ASSERT(sink.data + sink.datalen == p);
+
+  /* metrics_updated with BBR v2 fields */
+  cstat.bbr2_state = NGTCP2_BBR2_STATE_PROBE_RTT;
+  cstat.bbr2_max_bw = 1250000;
+  cstat.bbr2_bw_lo = UINT64_MAX;
+  cstat.bbr2_inflight_hi = 64000;
+  cstat.bbr2_inflight_lo = UINT64_MAX;
+  cstat.bbr2_inflight_too_high_count = 2;
+
+  ngtcp2_qlog_metrics_updated(&qlog, &cstat);
+
+  CU_ASSERT(NGTCP2_QLOG_BIN_EVENT_METRICS_UPDATED == qlog_bin_get_varint(&p));
+  CU_ASSERT(0 == qlog_bin_get_varint(&p));
+
+  bodylen = qlog_bin_get_varint(&p);
+
+  CU_ASSERT(sink.data + sink.datalen == p + bodylen);
+  CU_ASSERT((0x04 | 0x10) == qlog_bin_get_varint(&p));
+  CU_ASSERT(333 * NGTCP2_MILLISECONDS == qlog_bin_get_varint(&p));
+  CU_ASSERT(0 == qlog_bin_get_varint(&p));
+  CU_ASSERT(0 == qlog_bin_get_varint(&p));
+  CU_ASSERT(0 == qlog_bin_get_varint(&p));
+  CU_ASSERT(12000 == qlog_bin_get_varint(&p));
+  CU_ASSERT(0 == qlog_bin_get_varint(&p));
+  CU_ASSERT(NGTCP2_BBR2_STATE_PROBE_RTT == qlog_bin_get_varint(&p));
+  CU_ASSERT(1250000 == qlog_bin_get_varint(&p));
+  CU_ASSERT(64000 == qlog_bin_get_varint(&p));
+  CU_ASSERT(2 == qlog_bin_get_varint(&p));
+  CU_ASSERT(sink.data + sink.datalen == p);
+
+  /* The same event in JSON */
+  memset(&sink, 0, sizeof(sink));
+  qs.format = NGTCP2_QLOG_FORMAT_JSON_SEQ;
+
+  ngtcp2_qlog_init(&qlog, &qs, 0, &sink);
+  ngtcp2_buf_init(&qlog.buf, buf, sizeof(buf));
+
+  ngtcp2_qlog_metrics_updated(&qlog, &cstat);
+
+  CU_ASSERT(1 == sink.nwrite);
+  CU_ASSERT(NULL != strstr((const char *)sink.data,
+                           "\"bytes_in_flight\":0,\"bbr2_state\":\"probe_rtt\","
+                           "\"bbr2_max_bw\":1250000,"
+                           "\"bbr2_inflight_hi\":64000,"
+                           "\"bbr2_inflight_too_high_count\":2}}"));
+}
+
+void test_ngtcp2_qlog_filter(void) {
+  ngtcp2_qlog qlog;
+  ngtcp2_qlog_settings qs;
+  qlog_bin_sink sink;
+  uint8_t buf[NGTCP2_QLOG_BUFLEN];
+  ngtcp2_frame fr;
+  ngtcp2_pkt_hd hd;
+  ngtcp2_conn_stat cstat = {0};
+  ngtcp2_rtb_entry ent = {0};
+  const uint8_t *p;
+  size_t i;
+
+  memset(&hd, 0, sizeof(hd));
+  hd.type = NGTCP2_PKT_1RTT;
+
+  fr.type = NGTCP2_FRAME_PING;
+
+  /* Sample every 3rd packet, and omit frames */
+  memset(&sink, 0, sizeof(sink));
+  memset(&qs, 0, sizeof(qs));
+  qs.write = qlog_bin_write;
+  qs.format = NGTCP2_QLOG_FORMAT_BINARY;
+  qs.filter = NGTCP2_QLOG_FILTER_FRAMES | NGTCP2_QLOG_FILTER_LOSS;
+  qs.pkt_sample_interval = 3;
+  qs.metrics_sample_interval = 2;
+
+  ngtcp2_qlog_init(&qlog, &qs, 0, &sink);
+  ngtcp2_buf_init(&qlog.buf, buf, sizeof(buf));
+
+  for (i = 0; i < 7; ++i) {
+    hd.pkt_num = (int64_t)i;
+
+    ngtcp2_qlog_pkt_sent_start(&qlog);
+    ngtcp2_qlog_write_frame(&qlog, &fr);
+    ngtcp2_qlog_pkt_sent_end(&qlog, &hd, 1200);
+  }
+
+  CU_ASSERT(3 == sink.nwrite);
+
+  p = sink.data;
+
+  for (i = 0; i < 3; ++i) {
+    CU_ASSERT(NGTCP2_QLOG_BIN_EVENT_PKT_SENT == qlog_bin_get_varint(&p));
+    CU_ASSERT(0 == qlog_bin_get_varint(&p));
+    qlog_bin_get_varint(&p);
+    /* No frames */
+    CU_ASSERT(0 == qlog_bin_get_varint(&p));
+    CU_ASSERT(NGTCP2_QLOG_BIN_PKT_TYPE_1RTT == qlog_bin_get_varint(&p));
+    CU_ASSERT(i * 3 == qlog_bin_get_varint(&p));
+    CU_ASSERT(0 == qlog_bin_get_varint(&p));
+    CU_ASSERT(1200 == qlog_bin_get_varint(&p));
+  }
+
+  CU_ASSERT(sink.data + sink.datalen == p);
+
+  for (i = 0; i < 4; ++i) {
+    ngtcp2_qlog_metrics_updated(&qlog, &cstat);
+  }
+
+  CU_ASSERT(5 == sink.nwrite);
+
+  ngtcp2_qlog_pkt_lost(&qlog, &ent);
+
+  CU_ASSERT(5 == sink.nwrite);
+
+  /* Only packet_lost */
+  memset(&sink, 0, sizeof(sink));
+  qs.format = NGTCP2_QLOG_FORMAT_JSON_SEQ;
+  qs.filter = NGTCP2_QLOG_FILTER_PKT | NGTCP2_QLOG_FILTER_METRICS |
+              NGTCP2_QLOG_FILTER_PARAMETERS;
+  qs.pkt_sample_interval = 0;
+  qs.metrics_sample_interval = 0;
+
+  ngtcp2_qlog_init(&qlog, &qs, 0, &sink);
+  ngtcp2_buf_init(&qlog.buf, buf, sizeof(buf));
+
+  ngtcp2_qlog_pkt_received_start(&qlog);
+  ngtcp2_qlog_write_frame(&qlog, &fr);
+  ngtcp2_qlog_pkt_received_end(&qlog, &hd, 1200);
+  ngtcp2_qlog_metrics_updated(&qlog, &cstat);
+
+  CU_ASSERT(0 == sink.nwrite);
+
+  ngtcp2_qlog_pkt_lost(&qlog, &ent);
+
+  CU_ASSERT(1 == sink.nwrite);
+  CU_ASSERT(NULL != strstr((const char *)sink.data, "recovery:packet_lost"));
+}
@@ -89,3 +89,40 @@ void test_ngtcp2_ringbuf_pop_front(void) {
 
   ngtcp2_ringbuf_free(&rb);
 }
+
+void test_ngtcp2_ringbuf_reserve(void) {
+  ngtcp2_ringbuf rb;
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  size_t i;
+  int rv;
+
+  ngtcp2_ringbuf_init(&rb, 4, sizeof(ints), mem);
+
+  /* Make the elements wrap around the end of the buffer. */
+  for (i = 0; i < 3; ++i) {
+    ints *p = ngtcp2_ringbuf_push_front(&rb);
+    p->a = (int32_t)i;
+  }
+
+  rv = ngtcp2_ringbuf_reserve(&rb, 16);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(16 == rb.nmemb);
+  CU_ASSERT(3 == ngtcp2_ringbuf_len(&rb));
+
+  for (i = 0; i < 3; ++i) {
+    ints *p = ngtcp2_ringbuf_get(&rb, i);
+
+    CU_ASSERT((int32_t)(2 - i) == p->a);
+  }
+
+  for (i = 3; i < 16; ++i) {
+    ints *p = ngtcp2_ringbuf_push_front(&rb);
+    p->a = (int32_t)i;
+  }
+
+  CU_ASSERT(ngtcp2_ringbuf_full(&rb));
+  CU_ASSERT(0 == ((ints *)ngtcp2_ringbuf_get(&rb, 15))->a);
+
+  ngtcp2_ringbuf_free(&rb);
+}
@@ -550,3 +550,214 @@ void test_ngtcp2_rob_remove_prefix(void) {
 
   ngtcp2_rob_free(&rob);
 }
+
+void test_ngtcp2_rob_sparse(void) {
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  ngtcp2_rob rob;
+  ngtcp2_rob_data *d;
+  ngtcp2_ksl_it it;
+  uint8_t data[8192];
+  const uint8_t *p;
+  size_t i, len;
+  int rv;
+
+  for (i = 0; i < sizeof(data); ++i) {
+    data[i] = (uint8_t)i;
+  }
+
+  ngtcp2_rob_init(&rob, 8192, mem);
+
+  /* An isolated fragment only takes the granules it touches. */
+  rv = ngtcp2_rob_push(&rob, 5000, &data[5000], 100);
+
+  CU_ASSERT(0 == rv);
+
+  it = ngtcp2_ksl_begin(&rob.dataksl);
+  d = ngtcp2_ksl_it_get(&it);
+
+  CU_ASSERT(4864 == d->range.begin);
+  CU_ASSERT(5120 == d->range.end);
+
+  /* Data which continues the buffer extends to the end of chunk. */
+  rv = ngtcp2_rob_push(&rob, 5100, &data[5100], 200);
+
+  CU_ASSERT(0 == rv);
+
+  ngtcp2_ksl_it_next(&it);
+  d = ngtcp2_ksl_it_get(&it);
+
+  CU_ASSERT(5120 == d->range.begin);
+  CU_ASSERT(8192 == d->range.end);
+
+  ngtcp2_ksl_it_next(&it);
+
+  CU_ASSERT(ngtcp2_ksl_it_end(&it));
+
+  /* A fragment close to the buffer does not overlap it. */
+  rv = ngtcp2_rob_push(&rob, 4800, &data[4800], 10);
+
+  CU_ASSERT(0 == rv);
+
+  it = ngtcp2_ksl_begin(&rob.dataksl);
+  d = ngtcp2_ksl_it_get(&it);
+
+  CU_ASSERT(4608 == d->range.begin);
+  CU_ASSERT(4864 == d->range.end);
+
+  rv = ngtcp2_rob_push(&rob, 0, &data[0], 4800);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(4810 == ngtcp2_rob_first_gap_offset(&rob));
+
+  rv = ngtcp2_rob_push(&rob, 4810, &data[4810], 190);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(5300 == ngtcp2_rob_first_gap_offset(&rob));
+
+  for (i = 0; i < 5300; i += len) {
+    len = ngtcp2_rob_data_at(&rob, &p, i);
+    if (len == 0) {
+      break;
+    }
+
+    CU_ASSERT(0 == memcmp(&data[i], p, len));
+
+    ngtcp2_rob_pop(&rob, i, len);
+  }
+
+  CU_ASSERT(5300 == i);
+
+  ngtcp2_rob_free(&rob);
+}
+
+void test_ngtcp2_rob_loan(void) {
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  ngtcp2_rob rob;
+  uint8_t data[256];
+  const uint8_t *p, *q;
+  size_t i, len;
+  int rv;
+
+  for (i = 0; i < sizeof(data); ++i) {
+    data[i] = (uint8_t)i;
+  }
+
+  ngtcp2_rob_init(&rob, 16, mem);
+
+  rv = ngtcp2_rob_push(&rob, 16, &data[16], 16);
+
+  CU_ASSERT(0 == rv);
+
+  rv = ngtcp2_rob_push(&rob, 0, &data[0], 16);
+
+  CU_ASSERT(0 == rv);
+
+  len = ngtcp2_rob_data_at(&rob, &p, 0);
+
+  CU_ASSERT(16 == len);
+
+  ngtcp2_rob_loan(&rob, 0, len);
+
+  CU_ASSERT(NULL != rob.loaned);
+
+  len = ngtcp2_rob_data_at(&rob, &q, 16);
+
+  CU_ASSERT(16 == len);
+
+  ngtcp2_rob_loan(&rob, 16, len);
+
+  CU_ASSERT(!ngtcp2_rob_data_buffered(&rob));
+
+  /* Loaned data stays valid until it is released. */
+  CU_ASSERT(0 == memcmp(&data[0], p, 16));
+  CU_ASSERT(0 == memcmp(&data[16], q, 16));
+
+  ngtcp2_rob_release(&rob, 16);
+
+  CU_ASSERT(16 == rob.loaned->range.begin);
+  CU_ASSERT(NULL == rob.loaned->next);
+  CU_ASSERT(0 == memcmp(&data[16], q, 16));
+
+  ngtcp2_rob_release(&rob, 32);
+
+  CU_ASSERT(NULL == rob.loaned);
+
+  /* Data which is already released is freed immediately. */
+  ngtcp2_rob_release(&rob, 48);
+
+  rv = ngtcp2_rob_push(&rob, 32, &data[32], 16);
+
+  CU_ASSERT(0 == rv);
+
+  len = ngtcp2_rob_data_at(&rob, &p, 32);
+
+  CU_ASSERT(16 == len);
+
+  ngtcp2_rob_loan(&rob, 32, len);
+
+  CU_ASSERT(NULL == rob.loaned);
+
+  /* ngtcp2_rob_free frees the loaned data. */
+  rv = ngtcp2_rob_push(&rob, 48, &data[48], 16);
+
+  CU_ASSERT(0 == rv);
+
+  len = ngtcp2_rob_data_at(&rob, &p, 48);
+  ngtcp2_rob_loan(&rob, 48, len);
+
+  CU_ASSERT(NULL != rob.loaned);
+
+  ngtcp2_rob_free(&rob);
+}
+
+void test_ngtcp2_rob_cache(void) {
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  ngtcp2_rob rob;
+  ngtcp2_rob_data *d;
+  ngtcp2_ksl_it it;
+  uint8_t data[1024];
+  size_t i;
+  int rv;
+
+  for (i = 0; i < sizeof(data); ++i) {
+    data[i] = (uint8_t)i;
+  }
+
+  ngtcp2_rob_init(&rob, 1024, mem);
+
+  rv = ngtcp2_rob_push(&rob, 100, &data[100], 100);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == rob.ngap_cache);
+  CU_ASSERT(0 == rob.ndata_cache);
+
+  /* The gap which is filled is kept for reuse. */
+  rv = ngtcp2_rob_push(&rob, 0, &data[0], 100);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == rob.ngap_cache);
+
+  /* So is the buffer which is no longer needed. */
+  rv = ngtcp2_rob_remove_prefix(&rob, 256);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == rob.ndata_cache);
+  CU_ASSERT(0 == ngtcp2_ksl_len(&rob.dataksl));
+
+  /* The next out of order fragment reuses both of them. */
+  rv = ngtcp2_rob_push(&rob, 300, &data[300], 50);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == rob.ngap_cache);
+  CU_ASSERT(0 == rob.ndata_cache);
+  CU_ASSERT(2 == ngtcp2_ksl_len(&rob.gapksl));
+
+  it = ngtcp2_ksl_begin(&rob.dataksl);
+  d = ngtcp2_ksl_it_get(&it);
+
+  CU_ASSERT(256 == d->range.begin);
+  CU_ASSERT(512 == d->range.end);
+  CU_ASSERT(0 == memcmp(d->begin + 44, &data[300], 50));
+
+  ngtcp2_rob_free(&rob);
+}
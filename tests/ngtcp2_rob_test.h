@@ -32,6 +32,9 @@
 void test_ngtcp2_rob_push(void);
 void test_ngtcp2_rob_push_random(void);
 void test_ngtcp2_rob_data_at(void);
+void test_ngtcp2_rob_sparse(void);
+void test_ngtcp2_rob_loan(void);
+void test_ngtcp2_rob_cache(void);
 void test_ngtcp2_rob_remove_prefix(void);
 
 #endif /* NGTCP2_ROB_TEST_H */
@@ -38,6 +38,72 @@ static void conn_stat_init(ngtcp2_conn_stat *cstat) {
   cstat->max_udp_payload_size = NGTCP2_MAX_UDP_PAYLOAD_SIZE;
 }
 
+void test_ngtcp2_frame_chain_size_class(void) {
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  ngtcp2_objalloc frc_objalloc;
+  ngtcp2_frame_chain *frc, *frc4, *frc8;
+  int rv;
+
+  ngtcp2_objalloc_frame_chain_init(&frc_objalloc, 16, mem);
+
+  rv = ngtcp2_frame_chain_stream_datacnt_objalloc_new(&frc, 1, &frc_objalloc,
+                                                      mem);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_FRAME_CHAIN_SIZE_CLASS_BASE == frc->size_class);
+
+  ngtcp2_frame_chain_objalloc_del(frc, &frc_objalloc, mem);
+
+  rv = ngtcp2_frame_chain_stream_datacnt_objalloc_new(&frc4, 4, &frc_objalloc,
+                                                      mem);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_FRAME_CHAIN_SIZE_CLASS_DATACNT4 == frc4->size_class);
+
+  rv = ngtcp2_frame_chain_stream_datacnt_objalloc_new(&frc8, 8, &frc_objalloc,
+                                                      mem);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_FRAME_CHAIN_SIZE_CLASS_DATACNT8 == frc8->size_class);
+
+  rv = ngtcp2_frame_chain_stream_datacnt_objalloc_new(&frc, 9, &frc_objalloc,
+                                                      mem);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(NGTCP2_FRAME_CHAIN_SIZE_CLASS_HEAP == frc->size_class);
+
+  /* Shrinking frame does not change the size class. */
+  frc->fr.type = NGTCP2_FRAME_STREAM;
+  frc->fr.stream.datacnt = 1;
+
+  ngtcp2_frame_chain_objalloc_del(frc, &frc_objalloc, mem);
+
+  frc8->fr.type = NGTCP2_FRAME_STREAM;
+  frc8->fr.stream.datacnt = 1;
+
+  ngtcp2_frame_chain_objalloc_del(frc8, &frc_objalloc, mem);
+  ngtcp2_frame_chain_objalloc_del(frc4, &frc_objalloc, mem);
+
+  /* Released objects are reused for the same size class. */
+  rv = ngtcp2_frame_chain_crypto_datacnt_objalloc_new(&frc, 8, &frc_objalloc,
+                                                      mem);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(frc8 == frc);
+
+  ngtcp2_frame_chain_objalloc_del(frc, &frc_objalloc, mem);
+
+  rv = ngtcp2_frame_chain_stream_datacnt_objalloc_new(&frc, 4, &frc_objalloc,
+                                                      mem);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(frc4 == frc);
+
+  ngtcp2_frame_chain_objalloc_del(frc, &frc_objalloc, mem);
+
+  ngtcp2_objalloc_free(&frc_objalloc);
+}
+
 void test_ngtcp2_rtb_add(void) {
   ngtcp2_rtb rtb;
   ngtcp2_rtb_entry *ent;
@@ -46,7 +112,7 @@ void test_ngtcp2_rtb_add(void) {
   ngtcp2_pkt_hd hd;
   ngtcp2_log log;
   ngtcp2_cid dcid;
-  ngtcp2_ksl_it it;
+  ngtcp2_rtb_it it;
   ngtcp2_conn_stat cstat;
   ngtcp2_cc cc;
   ngtcp2_strm crypto;
@@ -63,8 +129,9 @@ void test_ngtcp2_rtb_add(void) {
   dcid_init(&dcid);
   conn_stat_init(&cstat);
   ngtcp2_rst_init(&rst);
-  ngtcp2_log_init(&log, NULL, NULL, 0, NULL);
-  ngtcp2_cc_reno_cc_init(&cc, &log, mem);
+  ngtcp2_log_init(&log, NULL, NULL, NULL, 0, NULL);
+  ngtcp2_cc_reno_cc_init(&cc, &log, /* hystart = */ 0,
+                         /* cwnd_validation = */ 0, mem);
   ngtcp2_rtb_init(&rtb, pktns_id, &crypto, &rst, &cc, &log, NULL,
                   &rtb_entry_objalloc, &frc_objalloc, mem);
 
@@ -99,24 +166,24 @@ void test_ngtcp2_rtb_add(void) {
   ngtcp2_rtb_add(&rtb, ent, &cstat);
 
   it = ngtcp2_rtb_head(&rtb);
-  ent = ngtcp2_ksl_it_get(&it);
+  ent = ngtcp2_rtb_it_get(&it);
 
   /* Check the top of the queue */
   CU_ASSERT(1000000009 == ent->hd.pkt_num);
 
-  ngtcp2_ksl_it_next(&it);
-  ent = ngtcp2_ksl_it_get(&it);
+  ngtcp2_rtb_it_next(&it);
+  ent = ngtcp2_rtb_it_get(&it);
 
   CU_ASSERT(1000000008 == ent->hd.pkt_num);
 
-  ngtcp2_ksl_it_next(&it);
-  ent = ngtcp2_ksl_it_get(&it);
+  ngtcp2_rtb_it_next(&it);
+  ent = ngtcp2_rtb_it_get(&it);
 
   CU_ASSERT(1000000007 == ent->hd.pkt_num);
 
-  ngtcp2_ksl_it_next(&it);
+  ngtcp2_rtb_it_next(&it);
 
-  CU_ASSERT(ngtcp2_ksl_it_end(&it));
+  CU_ASSERT(ngtcp2_rtb_it_end(&it));
 
   ngtcp2_rtb_free(&rtb);
   ngtcp2_cc_reno_cc_free(&cc, mem);
@@ -156,15 +223,222 @@ static void setup_rtb_fixture(ngtcp2_rtb *rtb, ngtcp2_conn_stat *cstat,
 }
 
 static void assert_rtb_entry_not_found(ngtcp2_rtb *rtb, int64_t pkt_num) {
-  ngtcp2_ksl_it it = ngtcp2_rtb_head(rtb);
+  ngtcp2_rtb_it it = ngtcp2_rtb_head(rtb);
   ngtcp2_rtb_entry *ent;
 
-  for (; !ngtcp2_ksl_it_end(&it); ngtcp2_ksl_it_next(&it)) {
-    ent = ngtcp2_ksl_it_get(&it);
+  for (; !ngtcp2_rtb_it_end(&it); ngtcp2_rtb_it_next(&it)) {
+    ent = ngtcp2_rtb_it_get(&it);
     CU_ASSERT(ent->hd.pkt_num != pkt_num);
   }
 }
 
+void test_ngtcp2_rtb_ents(void) {
+  ngtcp2_rtb rtb;
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  ngtcp2_max_frame mfr;
+  ngtcp2_ack *fr = &mfr.ackfr.ack;
+  ngtcp2_log log;
+  ngtcp2_conn_stat cstat;
+  ngtcp2_cc cc;
+  ngtcp2_pkt_hd hd;
+  ngtcp2_cid dcid;
+  ngtcp2_rtb_entry *ent;
+  ngtcp2_rtb_it it;
+  ngtcp2_ssize num_acked;
+  ngtcp2_strm crypto;
+  const ngtcp2_pktns_id pktns_id = NGTCP2_PKTNS_ID_HANDSHAKE;
+  ngtcp2_rst rst;
+  ngtcp2_objalloc frc_objalloc;
+  ngtcp2_objalloc rtb_entry_objalloc;
+  int rv;
+
+  ngtcp2_objalloc_init(&frc_objalloc, 1024, mem);
+  ngtcp2_objalloc_init(&rtb_entry_objalloc, 1024, mem);
+
+  ngtcp2_strm_init(&crypto, 0, NGTCP2_STRM_FLAG_NONE, 0, 0, NULL, &frc_objalloc,
+                   mem);
+  dcid_init(&dcid);
+  conn_stat_init(&cstat);
+  ngtcp2_rst_init(&rst);
+  ngtcp2_log_init(&log, NULL, NULL, NULL, 0, NULL);
+  ngtcp2_cc_reno_cc_init(&cc, &log, /* hystart = */ 0,
+                         /* cwnd_validation = */ 0, mem);
+  ngtcp2_rtb_init(&rtb, pktns_id, &crypto, &rst, &cc, &log, NULL,
+                  &rtb_entry_objalloc, &frc_objalloc, mem);
+
+  it = ngtcp2_rtb_head(&rtb);
+
+  CU_ASSERT(ngtcp2_rtb_it_end(&it));
+  CU_ASSERT(ngtcp2_rtb_it_begin(&it));
+
+  /* The ring grows as the span of packet numbers widens. */
+  setup_rtb_fixture(&rtb, &cstat, &rtb_entry_objalloc);
+
+  CU_ASSERT(67 == rtb.ents.len);
+  CU_ASSERT(100 == rtb.ents.base);
+  CU_ASSERT(446 == rtb.ents.last);
+  CU_ASSERT(512 == rtb.ents.cap);
+
+  /* Duplicated packet number */
+  ngtcp2_pkt_hd_init(&hd, NGTCP2_PKT_FLAG_NONE, NGTCP2_PKT_1RTT, &dcid, NULL,
+                     181, 1, NGTCP2_PROTO_VER_V1, 0);
+  ngtcp2_rtb_entry_objalloc_new(&ent, &hd, NULL, 0, 0,
+                                NGTCP2_RTB_ENTRY_FLAG_NONE,
+                                &rtb_entry_objalloc);
+
+  rv = ngtcp2_rtb_add(&rtb, ent, &cstat);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
+
+  ngtcp2_rtb_entry_objalloc_del(ent, &rtb_entry_objalloc, &frc_objalloc, mem);
+
+  /* Packet number smaller than base */
+  add_rtb_entry_range(&rtb, 90, 1, &cstat, &rtb_entry_objalloc);
+
+  CU_ASSERT(68 == rtb.ents.len);
+  CU_ASSERT(90 == rtb.ents.base);
+  CU_ASSERT(446 == rtb.ents.last);
+
+  it = ngtcp2_rtb_lower_bound(&rtb, 179);
+
+  CU_ASSERT(154 == ngtcp2_rtb_it_get(&it)->hd.pkt_num);
+
+  ngtcp2_rtb_it_prev(&it);
+
+  CU_ASSERT(180 == ngtcp2_rtb_it_get(&it)->hd.pkt_num);
+
+  ngtcp2_rtb_it_next(&it);
+  ngtcp2_rtb_it_next(&it);
+
+  CU_ASSERT(153 == ngtcp2_rtb_it_get(&it)->hd.pkt_num);
+
+  it = ngtcp2_rtb_lower_bound(&rtb, 1000);
+
+  CU_ASSERT(446 == ngtcp2_rtb_it_get(&it)->hd.pkt_num);
+  CU_ASSERT(ngtcp2_rtb_it_begin(&it));
+
+  it = ngtcp2_rtb_lower_bound(&rtb, 89);
+
+  CU_ASSERT(ngtcp2_rtb_it_end(&it));
+
+  it = ngtcp2_rtb_lower_bound(&rtb, 99);
+
+  CU_ASSERT(90 == ngtcp2_rtb_it_get(&it)->hd.pkt_num);
+
+  ngtcp2_rtb_it_next(&it);
+
+  CU_ASSERT(ngtcp2_rtb_it_end(&it));
+
+  it = ngtcp2_rtb_end(&rtb);
+  ngtcp2_rtb_it_prev(&it);
+
+  CU_ASSERT(90 == ngtcp2_rtb_it_get(&it)->hd.pkt_num);
+
+  ngtcp2_rtb_it_prev(&it);
+
+  CU_ASSERT(100 == ngtcp2_rtb_it_get(&it)->hd.pkt_num);
+
+  /* Acknowledging the largest packets shrinks the span. */
+  fr->largest_ack = 446;
+  fr->first_ack_blklen = 6;
+  fr->num_blks = 0;
+
+  num_acked =
+      ngtcp2_rtb_recv_ack(&rtb, fr, &cstat, NULL, NULL, 1000000009, 1000000009);
+
+  CU_ASSERT(7 == num_acked);
+  CU_ASSERT(61 == rtb.ents.len);
+  CU_ASSERT(90 == rtb.ents.base);
+  CU_ASSERT(184 == rtb.ents.last);
+  /* The ring shrinks as the range narrows. */
+  CU_ASSERT(256 == rtb.ents.cap);
+
+  it = ngtcp2_rtb_head(&rtb);
+
+  CU_ASSERT(184 == ngtcp2_rtb_it_get(&it)->hd.pkt_num);
+
+  /* Acknowledging the smallest packet moves base forward. */
+  fr->largest_ack = 90;
+  fr->first_ack_blklen = 0;
+  fr->num_blks = 0;
+
+  num_acked =
+      ngtcp2_rtb_recv_ack(&rtb, fr, &cstat, NULL, NULL, 1000000009, 1000000009);
+
+  CU_ASSERT(1 == num_acked);
+  CU_ASSERT(60 == rtb.ents.len);
+  CU_ASSERT(100 == rtb.ents.base);
+  CU_ASSERT(184 == rtb.ents.last);
+
+  /* The entries move to the skip list if the range of packet numbers
+     exceeds NGTCP2_RTB_ENTS_MAX_CAP. */
+  add_rtb_entry_range(&rtb, 1000000009, 1, &cstat, &rtb_entry_objalloc);
+
+  CU_ASSERT(61 == rtb.ents.len);
+  CU_ASSERT(rtb.ents.use_sparse);
+  CU_ASSERT(0 == rtb.ents.cap);
+  CU_ASSERT(100 == rtb.ents.base);
+  CU_ASSERT(1000000009 == rtb.ents.last);
+
+  it = ngtcp2_rtb_lower_bound(&rtb, 1000000000);
+
+  CU_ASSERT(184 == ngtcp2_rtb_it_get(&it)->hd.pkt_num);
+
+  ngtcp2_rtb_it_prev(&it);
+
+  CU_ASSERT(1000000009 == ngtcp2_rtb_it_get(&it)->hd.pkt_num);
+  CU_ASSERT(ngtcp2_rtb_it_begin(&it));
+
+  it = ngtcp2_rtb_end(&rtb);
+  ngtcp2_rtb_it_prev(&it);
+
+  CU_ASSERT(100 == ngtcp2_rtb_it_get(&it)->hd.pkt_num);
+
+  ngtcp2_rtb_it_next(&it);
+
+  CU_ASSERT(ngtcp2_rtb_it_end(&it));
+
+  /* Duplicated packet number */
+  ngtcp2_pkt_hd_init(&hd, NGTCP2_PKT_FLAG_NONE, NGTCP2_PKT_1RTT, &dcid, NULL,
+                     184, 1, NGTCP2_PROTO_VER_V1, 0);
+  ngtcp2_rtb_entry_objalloc_new(&ent, &hd, NULL, 0, 0,
+                                NGTCP2_RTB_ENTRY_FLAG_NONE,
+                                &rtb_entry_objalloc);
+
+  rv = ngtcp2_rtb_add(&rtb, ent, &cstat);
+
+  CU_ASSERT(NGTCP2_ERR_INVALID_ARGUMENT == rv);
+
+  ngtcp2_rtb_entry_objalloc_del(ent, &rtb_entry_objalloc, &frc_objalloc, mem);
+
+  /* They move back to the ring once the range narrows. */
+  fr->largest_ack = 1000000009;
+  fr->first_ack_blklen = 0;
+  fr->num_blks = 0;
+
+  num_acked =
+      ngtcp2_rtb_recv_ack(&rtb, fr, &cstat, NULL, NULL, 1000000009, 1000000009);
+
+  CU_ASSERT(1 == num_acked);
+  CU_ASSERT(60 == rtb.ents.len);
+  CU_ASSERT(!rtb.ents.use_sparse);
+  CU_ASSERT(128 == rtb.ents.cap);
+  CU_ASSERT(100 == rtb.ents.base);
+  CU_ASSERT(184 == rtb.ents.last);
+
+  it = ngtcp2_rtb_head(&rtb);
+
+  CU_ASSERT(184 == ngtcp2_rtb_it_get(&it)->hd.pkt_num);
+
+  ngtcp2_rtb_free(&rtb);
+
+  ngtcp2_cc_reno_cc_free(&cc, mem);
+  ngtcp2_strm_free(&crypto);
+
+  ngtcp2_objalloc_free(&rtb_entry_objalloc);
+  ngtcp2_objalloc_free(&frc_objalloc);
+}
+
 void test_ngtcp2_rtb_recv_ack(void) {
   ngtcp2_rtb rtb;
   const ngtcp2_mem *mem = ngtcp2_mem_default();
@@ -187,19 +461,20 @@ void test_ngtcp2_rtb_recv_ack(void) {
 
   ngtcp2_strm_init(&crypto, 0, NGTCP2_STRM_FLAG_NONE, 0, 0, NULL, &frc_objalloc,
                    mem);
-  ngtcp2_log_init(&log, NULL, NULL, 0, NULL);
+  ngtcp2_log_init(&log, NULL, NULL, NULL, 0, NULL);
   ngtcp2_pkt_hd_init(&hd, NGTCP2_PKT_FLAG_NONE, NGTCP2_PKT_1RTT, NULL, NULL, 0,
                      1, NGTCP2_PROTO_VER_V1, 0);
 
   /* no ack block */
   conn_stat_init(&cstat);
   ngtcp2_rst_init(&rst);
-  ngtcp2_cc_reno_cc_init(&cc, &log, mem);
+  ngtcp2_cc_reno_cc_init(&cc, &log, /* hystart = */ 0,
+                         /* cwnd_validation = */ 0, mem);
   ngtcp2_rtb_init(&rtb, pktns_id, &crypto, &rst, &cc, &log, NULL,
                   &rtb_entry_objalloc, &frc_objalloc, mem);
   setup_rtb_fixture(&rtb, &cstat, &rtb_entry_objalloc);
 
-  CU_ASSERT(67 == ngtcp2_ksl_len(&rtb.ents));
+  CU_ASSERT(67 == rtb.ents.len);
 
   fr->largest_ack = 446;
   fr->first_ack_blklen = 1;
@@ -209,7 +484,7 @@ void test_ngtcp2_rtb_recv_ack(void) {
       ngtcp2_rtb_recv_ack(&rtb, fr, &cstat, NULL, NULL, 1000000009, 1000000009);
 
   CU_ASSERT(2 == num_acked);
-  CU_ASSERT(65 == ngtcp2_ksl_len(&rtb.ents));
+  CU_ASSERT(65 == rtb.ents.len);
   assert_rtb_entry_not_found(&rtb, 446);
   assert_rtb_entry_not_found(&rtb, 445);
 
@@ -218,7 +493,8 @@ void test_ngtcp2_rtb_recv_ack(void) {
 
   /* with ack block */
   conn_stat_init(&cstat);
-  ngtcp2_cc_reno_cc_init(&cc, &log, mem);
+  ngtcp2_cc_reno_cc_init(&cc, &log, /* hystart = */ 0,
+                         /* cwnd_validation = */ 0, mem);
   ngtcp2_rtb_init(&rtb, pktns_id, &crypto, &rst, &cc, &log, NULL,
                   &rtb_entry_objalloc, &frc_objalloc, mem);
   setup_rtb_fixture(&rtb, &cstat, &rtb_entry_objalloc);
@@ -236,7 +512,7 @@ void test_ngtcp2_rtb_recv_ack(void) {
       ngtcp2_rtb_recv_ack(&rtb, fr, &cstat, NULL, NULL, 1000000009, 1000000009);
 
   CU_ASSERT(4 == num_acked);
-  CU_ASSERT(63 == ngtcp2_ksl_len(&rtb.ents));
+  CU_ASSERT(63 == rtb.ents.len);
   CU_ASSERT(441 == rtb.largest_acked_tx_pkt_num);
   assert_rtb_entry_not_found(&rtb, 441);
   assert_rtb_entry_not_found(&rtb, 440);
@@ -248,7 +524,8 @@ void test_ngtcp2_rtb_recv_ack(void) {
 
   /* gap+blklen points to pkt_num 0 */
   conn_stat_init(&cstat);
-  ngtcp2_cc_reno_cc_init(&cc, &log, mem);
+  ngtcp2_cc_reno_cc_init(&cc, &log, /* hystart = */ 0,
+                         /* cwnd_validation = */ 0, mem);
   ngtcp2_rtb_init(&rtb, pktns_id, &crypto, &rst, &cc, &log, NULL,
                   &rtb_entry_objalloc, &frc_objalloc, mem);
   add_rtb_entry_range(&rtb, 0, 1, &cstat, &rtb_entry_objalloc);
@@ -270,7 +547,8 @@ void test_ngtcp2_rtb_recv_ack(void) {
 
   /* pkt_num = 0 (first ack block) */
   conn_stat_init(&cstat);
-  ngtcp2_cc_reno_cc_init(&cc, &log, mem);
+  ngtcp2_cc_reno_cc_init(&cc, &log, /* hystart = */ 0,
+                         /* cwnd_validation = */ 0, mem);
   ngtcp2_rtb_init(&rtb, pktns_id, &crypto, &rst, &cc, &log, NULL,
                   &rtb_entry_objalloc, &frc_objalloc, mem);
   add_rtb_entry_range(&rtb, 0, 1, &cstat, &rtb_entry_objalloc);
@@ -290,7 +568,8 @@ void test_ngtcp2_rtb_recv_ack(void) {
 
   /* pkt_num = 0 */
   conn_stat_init(&cstat);
-  ngtcp2_cc_reno_cc_init(&cc, &log, mem);
+  ngtcp2_cc_reno_cc_init(&cc, &log, /* hystart = */ 0,
+                         /* cwnd_validation = */ 0, mem);
   ngtcp2_rtb_init(&rtb, pktns_id, &crypto, &rst, &cc, &log, NULL,
                   &rtb_entry_objalloc, &frc_objalloc, mem);
   add_rtb_entry_range(&rtb, 0, 1, &cstat, &rtb_entry_objalloc);
@@ -324,7 +603,7 @@ void test_ngtcp2_rtb_lost_pkt_ts(void) {
   ngtcp2_cc cc;
   ngtcp2_rst rst;
   ngtcp2_conn_stat cstat;
-  ngtcp2_ksl_it it;
+  ngtcp2_rtb_it it;
   ngtcp2_rtb_entry *ent;
   ngtcp2_objalloc frc_objalloc;
   ngtcp2_objalloc rtb_entry_objalloc;
@@ -334,11 +613,12 @@ void test_ngtcp2_rtb_lost_pkt_ts(void) {
 
   ngtcp2_strm_init(&crypto, 0, NGTCP2_STRM_FLAG_NONE, 0, 0, NULL, &frc_objalloc,
                    mem);
-  ngtcp2_log_init(&log, NULL, NULL, 0, NULL);
+  ngtcp2_log_init(&log, NULL, NULL, NULL, 0, NULL);
 
   conn_stat_init(&cstat);
   ngtcp2_rst_init(&rst);
-  ngtcp2_cc_reno_cc_init(&cc, &log, mem);
+  ngtcp2_cc_reno_cc_init(&cc, &log, /* hystart = */ 0,
+                         /* cwnd_validation = */ 0, mem);
   ngtcp2_rtb_init(&rtb, pktns_id, &crypto, &rst, &cc, &log, NULL,
                   &rtb_entry_objalloc, &frc_objalloc, mem);
 
@@ -346,9 +626,9 @@ void test_ngtcp2_rtb_lost_pkt_ts(void) {
 
   CU_ASSERT(UINT64_MAX == ngtcp2_rtb_lost_pkt_ts(&rtb));
 
-  it = ngtcp2_ksl_end(&rtb.ents);
-  ngtcp2_ksl_it_prev(&it);
-  ent = ngtcp2_ksl_it_get(&it);
+  it = ngtcp2_rtb_end(&rtb);
+  ngtcp2_rtb_it_prev(&it);
+  ent = ngtcp2_rtb_it_get(&it);
   ent->flags |= NGTCP2_RTB_ENTRY_FLAG_LOST_RETRANSMITTED;
   ent->lost_ts = 16777217;
 
@@ -371,7 +651,7 @@ void test_ngtcp2_rtb_remove_expired_lost_pkt(void) {
   ngtcp2_cc cc;
   ngtcp2_rst rst;
   ngtcp2_conn_stat cstat;
-  ngtcp2_ksl_it it;
+  ngtcp2_rtb_it it;
   ngtcp2_rtb_entry *ent;
   size_t i;
   ngtcp2_objalloc frc_objalloc;
@@ -382,32 +662,33 @@ void test_ngtcp2_rtb_remove_expired_lost_pkt(void) {
 
   ngtcp2_strm_init(&crypto, 0, NGTCP2_STRM_FLAG_NONE, 0, 0, NULL, &frc_objalloc,
                    mem);
-  ngtcp2_log_init(&log, NULL, NULL, 0, NULL);
+  ngtcp2_log_init(&log, NULL, NULL, NULL, 0, NULL);
 
   conn_stat_init(&cstat);
   ngtcp2_rst_init(&rst);
-  ngtcp2_cc_reno_cc_init(&cc, &log, mem);
+  ngtcp2_cc_reno_cc_init(&cc, &log, /* hystart = */ 0,
+                         /* cwnd_validation = */ 0, mem);
   ngtcp2_rtb_init(&rtb, pktns_id, &crypto, &rst, &cc, &log, NULL,
                   &rtb_entry_objalloc, &frc_objalloc, mem);
 
   add_rtb_entry_range(&rtb, 0, 7, &cstat, &rtb_entry_objalloc);
 
-  it = ngtcp2_ksl_end(&rtb.ents);
+  it = ngtcp2_rtb_end(&rtb);
 
   for (i = 0; i < 5; ++i) {
-    ngtcp2_ksl_it_prev(&it);
-    ent = ngtcp2_ksl_it_get(&it);
+    ngtcp2_rtb_it_prev(&it);
+    ent = ngtcp2_rtb_it_get(&it);
     ent->flags |= NGTCP2_RTB_ENTRY_FLAG_LOST_RETRANSMITTED;
     ent->lost_ts = 16777217 + i;
   }
 
   ngtcp2_rtb_remove_expired_lost_pkt(&rtb, 1, 16777219);
 
-  CU_ASSERT(5 == ngtcp2_ksl_len(&rtb.ents));
+  CU_ASSERT(5 == rtb.ents.len);
 
   ngtcp2_rtb_remove_expired_lost_pkt(&rtb, 1, 16777223);
 
-  CU_ASSERT(2 == ngtcp2_ksl_len(&rtb.ents));
+  CU_ASSERT(2 == rtb.ents.len);
 
   ngtcp2_rtb_free(&rtb);
   ngtcp2_cc_reno_cc_free(&cc, mem);
@@ -426,7 +707,7 @@ void test_ngtcp2_rtb_remove_excessive_lost_pkt(void) {
   ngtcp2_cc cc;
   ngtcp2_rst rst;
   ngtcp2_conn_stat cstat;
-  ngtcp2_ksl_it it;
+  ngtcp2_rtb_it it;
   ngtcp2_rtb_entry *ent;
   size_t i;
   ngtcp2_objalloc frc_objalloc;
@@ -437,21 +718,22 @@ void test_ngtcp2_rtb_remove_excessive_lost_pkt(void) {
 
   ngtcp2_strm_init(&crypto, 0, NGTCP2_STRM_FLAG_NONE, 0, 0, NULL, &frc_objalloc,
                    mem);
-  ngtcp2_log_init(&log, NULL, NULL, 0, NULL);
+  ngtcp2_log_init(&log, NULL, NULL, NULL, 0, NULL);
 
   conn_stat_init(&cstat);
   ngtcp2_rst_init(&rst);
-  ngtcp2_cc_reno_cc_init(&cc, &log, mem);
+  ngtcp2_cc_reno_cc_init(&cc, &log, /* hystart = */ 0,
+                         /* cwnd_validation = */ 0, mem);
   ngtcp2_rtb_init(&rtb, pktns_id, &crypto, &rst, &cc, &log, NULL,
                   &rtb_entry_objalloc, &frc_objalloc, mem);
 
   add_rtb_entry_range(&rtb, 0, 7, &cstat, &rtb_entry_objalloc);
 
-  it = ngtcp2_ksl_end(&rtb.ents);
+  it = ngtcp2_rtb_end(&rtb);
 
   for (i = 0; i < 5; ++i) {
-    ngtcp2_ksl_it_prev(&it);
-    ent = ngtcp2_ksl_it_get(&it);
+    ngtcp2_rtb_it_prev(&it);
+    ent = ngtcp2_rtb_it_get(&it);
     ent->flags |= NGTCP2_RTB_ENTRY_FLAG_LOST_RETRANSMITTED;
     ent->lost_ts = 16777217;
     ++rtb.num_lost_pkts;
@@ -459,7 +741,7 @@ void test_ngtcp2_rtb_remove_excessive_lost_pkt(void) {
 
   ngtcp2_rtb_remove_excessive_lost_pkt(&rtb, 2);
 
-  CU_ASSERT(4 == ngtcp2_ksl_len(&rtb.ents));
+  CU_ASSERT(4 == rtb.ents.len);
 
   ngtcp2_rtb_free(&rtb);
   ngtcp2_cc_reno_cc_free(&cc, mem);
@@ -468,3 +750,51 @@ void test_ngtcp2_rtb_remove_excessive_lost_pkt(void) {
   ngtcp2_objalloc_free(&rtb_entry_objalloc);
   ngtcp2_objalloc_free(&frc_objalloc);
 }
+
+void test_ngtcp2_cryptofrq(void) {
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  ngtcp2_objalloc frc_objalloc;
+  ngtcp2_cryptofrq frq;
+  ngtcp2_frame_chain *frc;
+  const uint64_t offsets[] = {100, 200, 300, 0, 150, 400, 150};
+  const uint64_t expected[] = {0, 100, 150, 150, 200, 300, 400};
+  size_t i;
+
+  ngtcp2_objalloc_init(&frc_objalloc, 1024, mem);
+  ngtcp2_cryptofrq_init(&frq);
+
+  for (i = 0; i < arraylen(offsets); ++i) {
+    ngtcp2_frame_chain_objalloc_new(&frc, &frc_objalloc);
+    frc->fr.type = NGTCP2_FRAME_CRYPTO;
+    frc->fr.crypto.offset = offsets[i];
+    frc->fr.crypto.datacnt = 0;
+
+    ngtcp2_cryptofrq_push(&frq, frc);
+  }
+
+  CU_ASSERT(arraylen(offsets) == frq.len);
+  CU_ASSERT(400 == frq.tail->fr.crypto.offset);
+
+  for (i = 0; i < 3; ++i) {
+    frc = ngtcp2_cryptofrq_pop(&frq);
+
+    CU_ASSERT(expected[i] == frc->fr.crypto.offset);
+    CU_ASSERT(NULL == frc->next);
+
+    ngtcp2_frame_chain_objalloc_del(frc, &frc_objalloc, mem);
+  }
+
+  for (frc = frq.head, i = 3; frc; frc = frc->next, ++i) {
+    CU_ASSERT(expected[i] == frc->fr.crypto.offset);
+  }
+
+  CU_ASSERT(arraylen(expected) == i);
+
+  ngtcp2_cryptofrq_clear(&frq, &frc_objalloc, mem);
+
+  CU_ASSERT(0 == frq.len);
+  CU_ASSERT(NULL == frq.head);
+  CU_ASSERT(NULL == frq.tail);
+
+  ngtcp2_objalloc_free(&frc_objalloc);
+}
@@ -29,10 +29,13 @@
 #  include <config.h>
 #endif /* HAVE_CONFIG_H */
 
+void test_ngtcp2_frame_chain_size_class(void);
 void test_ngtcp2_rtb_add(void);
+void test_ngtcp2_rtb_ents(void);
 void test_ngtcp2_rtb_recv_ack(void);
 void test_ngtcp2_rtb_lost_pkt_ts(void);
 void test_ngtcp2_rtb_remove_expired_lost_pkt(void);
 void test_ngtcp2_rtb_remove_excessive_lost_pkt(void);
+void test_ngtcp2_cryptofrq(void);
 
 #endif /* NGTCP2_RTB_TEST_H */
@@ -0,0 +1,64 @@
+/*
+ * ngtcp2
+ *
+ * Copyright (c) 2023 ngtcp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ngtcp2_seqlock_test.h"
+
+#include <CUnit/CUnit.h>
+
+#include "ngtcp2_seqlock.h"
+
+void test_ngtcp2_seqlock(void) {
+  ngtcp2_seqlock lock;
+  uint32_t seq;
+
+  ngtcp2_seqlock_init(&lock);
+
+  seq = ngtcp2_seqlock_read_begin(&lock);
+
+  CU_ASSERT(0 == seq);
+  CU_ASSERT(!ngtcp2_seqlock_read_retry(&lock, seq));
+
+  /* A write in the middle of a read forces a retry. */
+  ngtcp2_seqlock_write_begin(&lock);
+
+  CU_ASSERT(1 == lock.seq);
+
+  ngtcp2_seqlock_write_end(&lock);
+
+  CU_ASSERT(2 == lock.seq);
+  CU_ASSERT(ngtcp2_seqlock_read_retry(&lock, seq));
+
+  seq = ngtcp2_seqlock_read_begin(&lock);
+
+  CU_ASSERT(2 == seq);
+  CU_ASSERT(!ngtcp2_seqlock_read_retry(&lock, seq));
+
+  /* A write which has started but not finished also forces a
+     retry. */
+  ngtcp2_seqlock_write_begin(&lock);
+
+  CU_ASSERT(ngtcp2_seqlock_read_retry(&lock, seq));
+
+  ngtcp2_seqlock_write_end(&lock);
+}
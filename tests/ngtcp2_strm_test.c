@@ -312,6 +312,138 @@ void test_ngtcp2_strm_streamfrq_pop(void) {
   ngtcp2_objalloc_free(&frc_objalloc);
 }
 
+static ngtcp2_frame_chain *
+strm_stream_frame_chain_new(uint64_t offset, size_t datalen, int fin,
+                            ngtcp2_objalloc *frc_objalloc,
+                            const ngtcp2_mem *mem) {
+  ngtcp2_frame_chain *frc;
+
+  ngtcp2_frame_chain_stream_datacnt_objalloc_new(&frc, 1, frc_objalloc, mem);
+  frc->fr.stream.type = NGTCP2_FRAME_STREAM;
+  frc->fr.stream.flags = 0;
+  frc->fr.stream.fin = (uint8_t)fin;
+  frc->fr.stream.stream_id = 0;
+  frc->fr.stream.offset = offset;
+  frc->fr.stream.datacnt = 1;
+  frc->fr.stream.data[0].len = datalen;
+  frc->fr.stream.data[0].base = nulldata + offset;
+
+  return frc;
+}
+
+void test_ngtcp2_strm_streamfrq_push(void) {
+  ngtcp2_strm strm;
+  ngtcp2_frame_chain *frc;
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  int rv;
+  ngtcp2_objalloc frc_objalloc;
+  ngtcp2_ksl_it it;
+  ngtcp2_stream *fr;
+
+  ngtcp2_objalloc_init(&frc_objalloc, 1024, mem);
+
+  /* Overlapping data is split around the queued frames */
+  ngtcp2_strm_init(&strm, 0, NGTCP2_STRM_FLAG_NONE, 0, 0, NULL, &frc_objalloc,
+                   mem);
+
+  frc = strm_stream_frame_chain_new(0, 30, 0, &frc_objalloc, mem);
+  rv = ngtcp2_strm_streamfrq_push(&strm, frc);
+
+  CU_ASSERT(0 == rv);
+
+  frc = strm_stream_frame_chain_new(50, 20, 0, &frc_objalloc, mem);
+  rv = ngtcp2_strm_streamfrq_push(&strm, frc);
+
+  CU_ASSERT(0 == rv);
+
+  frc = strm_stream_frame_chain_new(20, 60, 1, &frc_objalloc, mem);
+  rv = ngtcp2_strm_streamfrq_push(&strm, frc);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(4 == ngtcp2_ksl_len(strm.tx.streamfrq));
+
+  it = ngtcp2_ksl_begin(strm.tx.streamfrq);
+  fr = &((ngtcp2_frame_chain *)ngtcp2_ksl_it_get(&it))->fr.stream;
+
+  CU_ASSERT(0 == fr->offset);
+  CU_ASSERT(30 == ngtcp2_vec_len(fr->data, fr->datacnt));
+  CU_ASSERT(0 == fr->fin);
+
+  ngtcp2_ksl_it_next(&it);
+  fr = &((ngtcp2_frame_chain *)ngtcp2_ksl_it_get(&it))->fr.stream;
+
+  CU_ASSERT(30 == fr->offset);
+  CU_ASSERT(20 == ngtcp2_vec_len(fr->data, fr->datacnt));
+  CU_ASSERT(nulldata + 30 == fr->data[0].base);
+  CU_ASSERT(0 == fr->fin);
+
+  ngtcp2_ksl_it_next(&it);
+  fr = &((ngtcp2_frame_chain *)ngtcp2_ksl_it_get(&it))->fr.stream;
+
+  CU_ASSERT(50 == fr->offset);
+  CU_ASSERT(20 == ngtcp2_vec_len(fr->data, fr->datacnt));
+  CU_ASSERT(0 == fr->fin);
+
+  ngtcp2_ksl_it_next(&it);
+  fr = &((ngtcp2_frame_chain *)ngtcp2_ksl_it_get(&it))->fr.stream;
+
+  CU_ASSERT(70 == fr->offset);
+  CU_ASSERT(10 == ngtcp2_vec_len(fr->data, fr->datacnt));
+  CU_ASSERT(nulldata + 70 == fr->data[0].base);
+  CU_ASSERT(1 == fr->fin);
+
+  frc = NULL;
+  rv = ngtcp2_strm_streamfrq_pop(&strm, &frc, 1024);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(0 == frc->fr.stream.offset);
+  CU_ASSERT(80 ==
+            ngtcp2_vec_len(frc->fr.stream.data, frc->fr.stream.datacnt));
+  CU_ASSERT(1 == frc->fr.stream.fin);
+  CU_ASSERT(0 == ngtcp2_ksl_len(strm.tx.streamfrq));
+
+  ngtcp2_frame_chain_objalloc_del(frc, &frc_objalloc, mem);
+  ngtcp2_strm_free(&strm);
+
+  /* Data which is entirely queued is discarded */
+  ngtcp2_strm_init(&strm, 0, NGTCP2_STRM_FLAG_NONE, 0, 0, NULL, &frc_objalloc,
+                   mem);
+
+  frc = strm_stream_frame_chain_new(0, 30, 0, &frc_objalloc, mem);
+  rv = ngtcp2_strm_streamfrq_push(&strm, frc);
+
+  CU_ASSERT(0 == rv);
+
+  frc = strm_stream_frame_chain_new(0, 30, 0, &frc_objalloc, mem);
+  rv = ngtcp2_strm_streamfrq_push(&strm, frc);
+
+  CU_ASSERT(0 == rv);
+
+  frc = strm_stream_frame_chain_new(5, 20, 0, &frc_objalloc, mem);
+  rv = ngtcp2_strm_streamfrq_push(&strm, frc);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == ngtcp2_ksl_len(strm.tx.streamfrq));
+
+  /* Only fin is new; it is merged into the queued frame. */
+  frc = strm_stream_frame_chain_new(10, 20, 1, &frc_objalloc, mem);
+  rv = ngtcp2_strm_streamfrq_push(&strm, frc);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 == ngtcp2_ksl_len(strm.tx.streamfrq));
+
+  it = ngtcp2_ksl_begin(strm.tx.streamfrq);
+  fr = &((ngtcp2_frame_chain *)ngtcp2_ksl_it_get(&it))->fr.stream;
+
+  CU_ASSERT(0 == fr->offset);
+  CU_ASSERT(30 == ngtcp2_vec_len(fr->data, fr->datacnt));
+  CU_ASSERT(1 == fr->fin);
+
+  ngtcp2_strm_free(&strm);
+
+  ngtcp2_objalloc_free(&frc_objalloc);
+}
+
 void test_ngtcp2_strm_streamfrq_unacked_offset(void) {
   ngtcp2_strm strm;
   ngtcp2_frame_chain *frc;
@@ -573,3 +705,83 @@ void test_ngtcp2_strm_streamfrq_unacked_pop(void) {
 
   ngtcp2_objalloc_free(&frc_objalloc);
 }
+
+void test_ngtcp2_strm_pool(void) {
+  const ngtcp2_mem *mem = ngtcp2_mem_default();
+  ngtcp2_strm strm;
+  ngtcp2_strm_pool pool;
+  ngtcp2_objalloc frc_objalloc;
+  ngtcp2_frame_chain *frc;
+  ngtcp2_rob *rob;
+  ngtcp2_ksl *streamfrq;
+  ngtcp2_gaptr *acked_offset;
+  const uint8_t *data;
+  int rv;
+
+  ngtcp2_objalloc_init(&frc_objalloc, 1024, mem);
+  ngtcp2_strm_pool_init(&pool);
+
+  setup_strm_streamfrq_fixture(&strm, &frc_objalloc, mem);
+  strm.pool = &pool;
+
+  rv = ngtcp2_strm_recv_reordering(&strm, nulldata, 100, 1000);
+
+  CU_ASSERT(0 == rv);
+
+  rv = ngtcp2_strm_ack_data(&strm, 100, 10);
+
+  CU_ASSERT(0 == rv);
+
+  rob = strm.rx.rob;
+  streamfrq = strm.tx.streamfrq;
+  acked_offset = strm.tx.acked_offset;
+
+  ngtcp2_strm_free(&strm);
+
+  CU_ASSERT(1 == pool.nrob);
+  CU_ASSERT(1 == pool.nstreamfrq);
+  CU_ASSERT(1 == pool.nacked_offset);
+
+  /* The next stream takes over the sub-objects, and they behave as
+     if they are new. */
+  ngtcp2_strm_init(&strm, 4, NGTCP2_STRM_FLAG_NONE, 1024, 0, NULL,
+                   &frc_objalloc, mem);
+  strm.pool = &pool;
+
+  rv = ngtcp2_strm_recv_reordering(&strm, nulldata, 100, 100);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(rob == strm.rx.rob);
+  CU_ASSERT(NGTCP2_STRM_ROB_MIN_CHUNK == strm.rx.rob->chunk);
+  CU_ASSERT(0 == ngtcp2_rob_data_at(strm.rx.rob, &data, 0));
+  CU_ASSERT(0 == pool.nrob);
+
+  ngtcp2_frame_chain_stream_datacnt_objalloc_new(&frc, 1, &frc_objalloc, mem);
+  frc->fr.stream.type = NGTCP2_FRAME_STREAM;
+  frc->fr.stream.fin = 0;
+  frc->fr.stream.offset = 0;
+  frc->fr.stream.datacnt = 1;
+  frc->fr.stream.data[0].len = 11;
+  frc->fr.stream.data[0].base = nulldata;
+
+  rv = ngtcp2_strm_streamfrq_push(&strm, frc);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(streamfrq == strm.tx.streamfrq);
+  CU_ASSERT(1 == ngtcp2_ksl_len(strm.tx.streamfrq));
+
+  rv = ngtcp2_strm_ack_data(&strm, 50, 10);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(acked_offset == strm.tx.acked_offset);
+  CU_ASSERT(0 == ngtcp2_strm_get_acked_offset(&strm));
+
+  rv = ngtcp2_strm_ack_data(&strm, 0, 50);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(60 == ngtcp2_strm_get_acked_offset(&strm));
+
+  ngtcp2_strm_free(&strm);
+  ngtcp2_strm_pool_free(&pool, mem);
+  ngtcp2_objalloc_free(&frc_objalloc);
+}
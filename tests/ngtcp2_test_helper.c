@@ -24,6 +24,7 @@
  */
 #include "ngtcp2_test_helper.h"
 
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
@@ -131,6 +132,8 @@ size_t write_single_frame_pkt_flags(uint8_t *out, size_t outlen, uint8_t flags,
   memset(&cc, 0, sizeof(cc));
   cc.encrypt = null_encrypt;
   cc.hp_mask = null_hp_mask;
+  cc.encrypt_hp_mask = NULL;
+  cc.encrypt_vec = NULL;
   cc.ckm = ckm;
   cc.aead.max_overhead = NGTCP2_FAKE_AEAD_OVERHEAD;
 
@@ -169,6 +172,8 @@ size_t write_pkt_flags(uint8_t *out, size_t outlen, uint8_t flags,
   memset(&cc, 0, sizeof(cc));
   cc.encrypt = null_encrypt;
   cc.hp_mask = null_hp_mask;
+  cc.encrypt_hp_mask = NULL;
+  cc.encrypt_vec = NULL;
   cc.ckm = ckm;
   cc.aead.max_overhead = NGTCP2_FAKE_AEAD_OVERHEAD;
 
@@ -203,6 +208,8 @@ size_t write_single_frame_pkt_without_conn_id(uint8_t *out, size_t outlen,
   memset(&cc, 0, sizeof(cc));
   cc.encrypt = null_encrypt;
   cc.hp_mask = null_hp_mask;
+  cc.encrypt_hp_mask = NULL;
+  cc.encrypt_vec = NULL;
   cc.ckm = ckm;
   cc.aead.max_overhead = NGTCP2_FAKE_AEAD_OVERHEAD;
 
@@ -234,6 +241,8 @@ static size_t write_single_frame_handshake_pkt_generic(
   memset(&cc, 0, sizeof(cc));
   cc.encrypt = null_encrypt;
   cc.hp_mask = null_hp_mask;
+  cc.encrypt_hp_mask = NULL;
+  cc.encrypt_vec = NULL;
   cc.ckm = ckm;
   switch (pkt_type) {
   case NGTCP2_PKT_INITIAL:
@@ -319,6 +328,8 @@ size_t write_handshake_pkt(uint8_t *out, size_t outlen, uint8_t pkt_type,
   memset(&cc, 0, sizeof(cc));
   cc.encrypt = null_encrypt;
   cc.hp_mask = null_hp_mask;
+  cc.encrypt_hp_mask = NULL;
+  cc.encrypt_vec = NULL;
   cc.ckm = ckm;
   switch (pkt_type) {
   case NGTCP2_PKT_INITIAL:
@@ -355,7 +366,7 @@ ngtcp2_strm *open_stream(ngtcp2_conn *conn, int64_t stream_id) {
   int rv;
   (void)rv;
 
-  strm = ngtcp2_objalloc_strm_get(&conn->strm_objalloc);
+  strm = ngtcp2_objalloc_strm_get(conn->strm_objalloc);
   assert(strm);
 
   rv = ngtcp2_conn_init_stream(conn, strm, stream_id, NULL);
@@ -515,3 +526,51 @@ void path_init(ngtcp2_path_storage *path, uint32_t local_addr,
   ngtcp2_path_storage_init(path, (ngtcp2_sockaddr *)&la, sizeof(la),
                            (ngtcp2_sockaddr *)&ra, sizeof(ra), NULL);
 }
+
+static void *countmem_malloc(size_t size, void *user_data) {
+  countmem *cm = user_data;
+  void *p = malloc(size);
+
+  if (p) {
+    ++cm->nalloc;
+  }
+
+  return p;
+}
+
+static void countmem_free(void *ptr, void *user_data) {
+  (void)user_data;
+
+  free(ptr);
+}
+
+static void *countmem_calloc(size_t nmemb, size_t size, void *user_data) {
+  countmem *cm = user_data;
+  void *p = calloc(nmemb, size);
+
+  if (p) {
+    ++cm->nalloc;
+  }
+
+  return p;
+}
+
+static void *countmem_realloc(void *ptr, size_t size, void *user_data) {
+  countmem *cm = user_data;
+  void *p = realloc(ptr, size);
+
+  if (p) {
+    ++cm->nalloc;
+  }
+
+  return p;
+}
+
+void countmem_init(countmem *cm) {
+  cm->mem.user_data = cm;
+  cm->mem.malloc = countmem_malloc;
+  cm->mem.free = countmem_free;
+  cm->mem.calloc = countmem_calloc;
+  cm->mem.realloc = countmem_realloc;
+  cm->nalloc = 0;
+}
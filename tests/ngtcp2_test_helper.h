@@ -236,4 +236,22 @@ ngtcp2_ssize pkt_decode_hd_short_mask(ngtcp2_pkt_hd *dest, const uint8_t *pkt,
 void path_init(ngtcp2_path_storage *path, uint32_t local_addr,
                uint16_t local_port, uint32_t remote_addr, uint16_t remote_port);
 
+/*
+ * countmem is a memory allocator which counts the number of
+ * allocations.  It is used to detect the allocations on the hot
+ * paths.
+ */
+typedef struct countmem {
+  ngtcp2_mem mem;
+  /* nalloc is the number of calls to malloc, calloc, and realloc
+     which returned non-NULL. */
+  size_t nalloc;
+} countmem;
+
+/*
+ * countmem_init initializes |cm|.  Pass &cm->mem to the library to
+ * count the allocations.
+ */
+void countmem_init(countmem *cm);
+
 #endif /* NGTCP2_TEST_HELPER_H */
@@ -266,6 +266,42 @@ void test_ngtcp2_vec_split(void) {
   CU_ASSERT(-1 == nsplit);
 }
 
+void test_ngtcp2_vec_split_at(void) {
+  uint8_t nulldata[1024];
+  ngtcp2_vec a[3];
+  size_t idx, offset;
+
+  a[0].len = 33;
+  a[0].base = nulldata;
+  a[1].len = 0;
+  a[1].base = nulldata + 33;
+  a[2].len = 89;
+  a[2].base = nulldata + 33;
+
+  /* Split in the middle of the first element */
+  idx = ngtcp2_vec_split_at(a, 3, 17, &offset);
+
+  CU_ASSERT(0 == idx);
+  CU_ASSERT(17 == offset);
+
+  /* Split at the boundary skips the empty element */
+  idx = ngtcp2_vec_split_at(a, 3, 33, &offset);
+
+  CU_ASSERT(2 == idx);
+  CU_ASSERT(0 == offset);
+
+  /* Split in the middle of the last element */
+  idx = ngtcp2_vec_split_at(a, 3, 121, &offset);
+
+  CU_ASSERT(2 == idx);
+  CU_ASSERT(88 == offset);
+
+  /* The elements are left intact */
+  CU_ASSERT(33 == a[0].len);
+  CU_ASSERT(0 == a[1].len);
+  CU_ASSERT(89 == a[2].len);
+}
+
 void test_ngtcp2_vec_merge(void) {
   uint8_t nulldata[1024];
   ngtcp2_vec a[16], b[16];
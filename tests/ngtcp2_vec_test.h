@@ -30,6 +30,7 @@
 #endif /* HAVE_CONFIG_H */
 
 void test_ngtcp2_vec_split(void);
+void test_ngtcp2_vec_split_at(void);
 void test_ngtcp2_vec_merge(void);
 void test_ngtcp2_vec_len_varint(void);
 